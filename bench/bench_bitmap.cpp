@@ -0,0 +1,86 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 位图求交计数，每次迭代处理1M位，比较标量和AVX2实现以及稀疏集合的Roaring
+#include "benchmark.h"
+#include <mooon/utils/bitmap.h>
+#include <mooon/utils/roaring_bitmap.h>
+#include <stdlib.h>
+
+#define BENCH_BITMAP_BITS (1024 * 1024)
+
+static void fill(mooon::utils::CBitmap* bitmap)
+{
+    for (size_t i=0; i<bitmap->word_number(); ++i)
+        bitmap->words()[i] = (static_cast<uint64_t>(random()) << 32) | static_cast<uint64_t>(random());
+}
+
+static void bitmap_and_count(CBenchmarkState& state, mooon::utils::CStringSimd::isa_t isa)
+{
+    mooon::utils::CBitmap a(BENCH_BITMAP_BITS), b(BENCH_BITMAP_BITS);
+    fill(&a);
+    fill(&b);
+    const mooon::utils::CStringSimd::isa_t old_isa = mooon::utils::CBitmap::set_isa(isa);
+
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        benchmark_do_not_optimize(a.and_count(b));
+    state.end();
+    (void)mooon::utils::CBitmap::set_isa(old_isa);
+}
+
+MOOON_BENCHMARK(bitmap_and_count_1m_scalar)(CBenchmarkState& state)
+{
+    bitmap_and_count(state, mooon::utils::CStringSimd::isa_scalar);
+}
+
+MOOON_BENCHMARK(bitmap_and_count_1m_avx2)(CBenchmarkState& state)
+{
+    bitmap_and_count(state, mooon::utils::CStringSimd::isa_avx2);
+}
+
+MOOON_BENCHMARK(bitmap_and_1m_avx2)(CBenchmarkState& state)
+{
+    mooon::utils::CBitmap a(BENCH_BITMAP_BITS), b(BENCH_BITMAP_BITS);
+    fill(&a);
+    fill(&b);
+
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        a &= b;
+        benchmark_clobber_memory();
+    }
+    state.end();
+}
+
+// 1M位中约1%为1，Roaring为数组容器
+MOOON_BENCHMARK(roaring_and_count_1m_sparse)(CBenchmarkState& state)
+{
+    mooon::utils::CRoaringBitmap a, b;
+    for (int i=0; i<BENCH_BITMAP_BITS/100; ++i)
+    {
+        (void)a.add(static_cast<uint32_t>(random() % BENCH_BITMAP_BITS));
+        (void)b.add(static_cast<uint32_t>(random() % BENCH_BITMAP_BITS));
+    }
+
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        benchmark_do_not_optimize(a.and_count(b));
+    state.end();
+}
@@ -0,0 +1,60 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 调用线程写一条日志的开销，CLogger异步由日志线程写文件，CSafeLogger在调用线程中写
+#include "benchmark.h"
+#include <mooon/sys/logger.h>
+#include <mooon/sys/safe_logger.h>
+
+// 日志器只创建一次，以免每次调用都计入创建和打开文件
+static mooon::sys::CLogger* get_logger()
+{
+    static mooon::sys::CLogger* logger = NULL;
+    if (NULL == logger)
+    {
+        logger = new mooon::sys::CLogger;
+        logger->create("/tmp", "mooon_bench.log", 100000);
+    }
+    return logger;
+}
+
+static mooon::sys::CSafeLogger* get_safe_logger()
+{
+    static mooon::sys::CSafeLogger* safe_logger = NULL;
+    if (NULL == safe_logger)
+        safe_logger = new mooon::sys::CSafeLogger("/tmp", "mooon_bench_safe.log");
+    return safe_logger;
+}
+
+MOOON_BENCHMARK(logger_log_info)(CBenchmarkState& state)
+{
+    mooon::sys::CLogger* logger = get_logger();
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        logger->log_info(__FILE__, __LINE__, NULL, "benchmark %s %" PRIu64, "logger", i);
+    state.end();
+}
+
+MOOON_BENCHMARK(safe_logger_log_info)(CBenchmarkState& state)
+{
+    mooon::sys::CSafeLogger* safe_logger = get_safe_logger();
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        safe_logger->log_info(__FILE__, __LINE__, NULL, "benchmark %s %" PRIu64, "safe logger", i);
+    state.end();
+}
@@ -0,0 +1,100 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 内存池和对象池一借一还的开销，以malloc/free为基线
+#include "benchmark.h"
+#include <mooon/sys/mem_pool.h>
+#include <mooon/sys/object_pool.h>
+#include <stdlib.h>
+
+MOOON_BENCHMARK(malloc_free_64)(CBenchmarkState& state)
+{
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        void* bucket = malloc(64);
+        benchmark_do_not_optimize(bucket);
+        free(bucket);
+    }
+    state.end();
+}
+
+static void thread_mem_pool_allocate_reclaim(CBenchmarkState& state, uint32_t magazine_size)
+{
+    mooon::sys::CThreadMemPool mem_pool;
+    mem_pool.create(64, 1024);
+    if (magazine_size > 0)
+        mem_pool.enable_thread_cache(magazine_size);
+
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        void* bucket = mem_pool.allocate();
+        benchmark_do_not_optimize(bucket);
+        (void)mem_pool.reclaim(bucket);
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(thread_mem_pool_allocate_reclaim)(CBenchmarkState& state)
+{
+    thread_mem_pool_allocate_reclaim(state, 0);
+}
+
+MOOON_BENCHMARK(thread_mem_pool_cached_allocate_reclaim)(CBenchmarkState& state)
+{
+    thread_mem_pool_allocate_reclaim(state, 32);
+}
+
+class CBenchmarkObject: public mooon::sys::CPoolObject
+{
+public:
+    void reset() {}
+
+    char data[64];
+};
+
+MOOON_BENCHMARK(thread_object_pool_borrow_pay_back)(CBenchmarkState& state)
+{
+    mooon::sys::CThreadObjectPool<CBenchmarkObject> object_pool(true);
+    object_pool.create(1024);
+
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        CBenchmarkObject* object = object_pool.borrow();
+        benchmark_do_not_optimize(object);
+        object_pool.pay_back(object);
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(lock_free_object_pool_borrow_pay_back)(CBenchmarkState& state)
+{
+    mooon::sys::CLockFreeObjectPool<CBenchmarkObject> object_pool(true);
+    object_pool.create(1024);
+
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        CBenchmarkObject* object = object_pool.borrow();
+        benchmark_do_not_optimize(object);
+        object_pool.pay_back(object);
+    }
+    state.end();
+}
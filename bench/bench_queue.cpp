@@ -0,0 +1,169 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 各队列单线程一进一出的开销，以及CEpollableQueue跨线程的吞吐
+#include "benchmark.h"
+#include <mooon/net/epollable_queue.h>
+#include <mooon/sys/event_queue.h>
+#include <mooon/utils/array_queue.h>
+#include <mooon/utils/mpsc_list_queue.h>
+#include <poll.h>
+#include <pthread.h>
+
+MOOON_BENCHMARK(array_queue_push_pop)(CBenchmarkState& state)
+{
+    mooon::utils::CArrayQueue<int> queue(1024);
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        queue.push_back(static_cast<int>(i));
+        benchmark_do_not_optimize(queue.pop_front());
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(event_queue_push_pop)(CBenchmarkState& state)
+{
+    mooon::sys::CEventQueue<mooon::utils::CArrayQueue<int> > queue(1024, 0, 0);
+    int elem;
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        (void)queue.push_back(static_cast<int>(i));
+        (void)queue.pop_front(elem);
+        benchmark_do_not_optimize(elem);
+    }
+    state.end();
+}
+
+struct BenchNode: public mooon::utils::CListable<BenchNode>
+{
+};
+
+// 侵入式无锁队列，入队一次原子交换，不分配内存
+MOOON_BENCHMARK(mpsc_list_queue_push_pop)(CBenchmarkState& state)
+{
+    mooon::utils::CMpscListQueue<BenchNode> queue;
+    BenchNode node;
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        (void)queue.push(&node);
+        benchmark_do_not_optimize(queue.pop());
+    }
+    state.end();
+}
+
+// 一次加锁批量push和pop 64个
+MOOON_BENCHMARK(event_queue_batch64)(CBenchmarkState& state)
+{
+    mooon::sys::CEventQueue<mooon::utils::CArrayQueue<int> > queue(1024, 0, 0);
+    int elem_array[64] = { 0 };
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); i+=64)
+    {
+        uint32_t array_size = 64;
+        (void)queue.push_back_batch(elem_array, array_size);
+        array_size = 64;
+        (void)queue.pop_front_batch(elem_array, array_size);
+        benchmark_do_not_optimize(elem_array[0]);
+    }
+    state.end();
+}
+
+// 每次都从空到非空，所以每次push都要写一次通知，pop都要读一次
+static void epollable_queue_push_pop(CBenchmarkState& state, bool use_eventfd)
+{
+    mooon::net::CEpollableQueue<mooon::utils::CArrayQueue<int> > queue(1024, use_eventfd);
+    int elem;
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        (void)queue.push_back(static_cast<int>(i));
+        (void)queue.pop_front(elem);
+        benchmark_do_not_optimize(elem);
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(epollable_queue_pipe_push_pop)(CBenchmarkState& state)
+{
+    epollable_queue_push_pop(state, false);
+}
+
+MOOON_BENCHMARK(epollable_queue_eventfd_push_pop)(CBenchmarkState& state)
+{
+    epollable_queue_push_pop(state, true);
+}
+
+// 批量push后一次pop_front(elem_array, array_size)取走
+MOOON_BENCHMARK(epollable_queue_eventfd_batch64)(CBenchmarkState& state)
+{
+    mooon::net::CEpollableQueue<mooon::utils::CArrayQueue<int> > queue(1024, true);
+    int elem_array[64];
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); i+=64)
+    {
+        for (int j=0; j<64; ++j)
+            (void)queue.push_back(j);
+        uint32_t array_size = 64;
+        queue.pop_front(elem_array, array_size);
+        benchmark_do_not_optimize(elem_array[0]);
+    }
+    state.end();
+}
+
+struct ProducerContext
+{
+    mooon::net::CEpollableQueue<mooon::utils::CArrayQueue<int> >* queue;
+    uint64_t number;
+};
+
+static void* produce(void* param)
+{
+    ProducerContext* context = static_cast<ProducerContext*>(param);
+    for (uint64_t i=0; i<context->number; ++i)
+    {
+        while (!context->queue->push_back(static_cast<int>(i), 1000))
+            ;
+    }
+    return NULL;
+}
+
+// 一个生产者线程一个消费者线程，每迭代传递一个元素，消费者在队列空时poll等待
+MOOON_BENCHMARK(epollable_queue_eventfd_two_threads)(CBenchmarkState& state)
+{
+    mooon::net::CEpollableQueue<mooon::utils::CArrayQueue<int> > queue(1024, true);
+    ProducerContext context = { &queue, state.iterations() };
+    pthread_t thread;
+
+    state.begin();
+    pthread_create(&thread, NULL, produce, &context);
+    for (uint64_t i=0; i<state.iterations();)
+    {
+        int elem_array[64];
+        uint32_t array_size = sizeof(elem_array) / sizeof(elem_array[0]);
+        struct pollfd fds = { queue.get_fd(), POLLIN, 0 };
+        if (poll(&fds, 1, 1000) <= 0)
+            continue;
+        queue.pop_front(elem_array, array_size);
+        i += array_size;
+    }
+    pthread_join(thread, NULL);
+    state.end();
+}
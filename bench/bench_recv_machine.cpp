@@ -0,0 +1,96 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CRecvMachine解析一个连续消息流的开销，每迭代一个消息，数据按4KB分块送入
+#include "benchmark.h"
+#include <mooon/net/recv_machine.h>
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+struct BenchmarkHeader
+{
+    uint32_t size; // 包体大小，不包含包头
+    uint32_t type;
+};
+
+class CBenchmarkProcessorManager
+{
+public:
+    CBenchmarkProcessorManager()
+        : _message_number(0), _body_bytes(0)
+    {
+    }
+
+    bool on_header(const BenchmarkHeader& header)
+    {
+        benchmark_do_not_optimize(header.type);
+        return true;
+    }
+
+    bool on_message(const BenchmarkHeader& header, size_t finished_size, const char* buffer, size_t buffer_size)
+    {
+        _body_bytes += buffer_size;
+        if (finished_size + buffer_size == header.size)
+            ++_message_number;
+        benchmark_do_not_optimize(buffer);
+        return true;
+    }
+
+    uint64_t get_message_number() const { return _message_number; }
+
+private:
+    uint64_t _message_number;
+    uint64_t _body_bytes;
+};
+
+// 生成包体大小在[16, 528)之间循环的消息流
+static void make_stream(std::vector<char>* stream, uint32_t message_number)
+{
+    for (uint32_t i=0; i<message_number; ++i)
+    {
+        BenchmarkHeader header;
+        header.size = 16 + (i * 37) % 512;
+        header.type = i;
+
+        const size_t offset = stream->size();
+        stream->resize(offset + sizeof(header) + header.size, 'm');
+        memcpy(&(*stream)[offset], &header, sizeof(header));
+    }
+}
+
+MOOON_BENCHMARK(recv_machine_4KB_chunks)(CBenchmarkState& state)
+{
+    static std::vector<char> stream;
+    const uint32_t stream_message_number = 1024;
+    if (stream.empty())
+        make_stream(&stream, stream_message_number);
+
+    CBenchmarkProcessorManager processor_manager;
+    mooon::net::CRecvMachine<BenchmarkHeader, CBenchmarkProcessorManager> recv_machine(&processor_manager);
+    state.begin();
+    while (processor_manager.get_message_number() < state.iterations())
+    {
+        for (size_t offset=0; offset<stream.size(); offset+=4096)
+        {
+            const size_t size = std::min(stream.size()-offset, static_cast<size_t>(4096));
+            (void)recv_machine.work(&stream[offset], size);
+        }
+    }
+    state.end();
+}
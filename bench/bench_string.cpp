@@ -0,0 +1,120 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 字符串切分、数值转换和哈希
+#include "benchmark.h"
+#include <mooon/utils/hash_utils.h>
+#include <mooon/utils/string_utils.h>
+#include <mooon/utils/tokener.h>
+#include <vector>
+
+MOOON_BENCHMARK(tokener_split)(CBenchmarkState& state)
+{
+    const std::string source = "mooon,benchmark,tokener,split,10.0.0.1,8080,1024";
+    std::vector<std::string> tokens;
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        tokens.clear();
+        (void)mooon::utils::CTokener::split(&tokens, source, ",");
+        benchmark_do_not_optimize(tokens.size());
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(string2int_uint64)(CBenchmarkState& state)
+{
+    uint64_t result;
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        (void)mooon::utils::CStringUtils::string2int("18446744073709551", result);
+        benchmark_do_not_optimize(result);
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(int_tostring_uint64)(CBenchmarkState& state)
+{
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        const std::string str = mooon::utils::CStringUtils::int_tostring(static_cast<uint64_t>(18446744073709551ULL + i));
+        benchmark_do_not_optimize(str.size());
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(uint64_toa)(CBenchmarkState& state)
+{
+    char buffer[20];
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        benchmark_do_not_optimize(mooon::utils::CStringUtils::uint64_toa(18446744073709551ULL + i, buffer));
+        benchmark_clobber_memory();
+    }
+    state.end();
+}
+
+MOOON_BENCHMARK(double_toa)(CBenchmarkState& state)
+{
+    char buffer[mooon::utils::CStringUtils::DOUBLE_TOA_BUFFER_SIZE];
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+    {
+        benchmark_do_not_optimize(mooon::utils::CStringUtils::double_toa(0.1 * static_cast<double>(i), buffer));
+        benchmark_clobber_memory();
+    }
+    state.end();
+}
+
+static void xxhash64(CBenchmarkState& state, size_t size)
+{
+    const std::string data(size, 'x');
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        benchmark_do_not_optimize(mooon::utils::CHashUtils::xxhash64(data.data(), data.size(), i));
+    state.end();
+}
+
+MOOON_BENCHMARK(xxhash64_64B)(CBenchmarkState& state)
+{
+    xxhash64(state, 64);
+}
+
+MOOON_BENCHMARK(xxhash64_1KB)(CBenchmarkState& state)
+{
+    xxhash64(state, 1024);
+}
+
+MOOON_BENCHMARK(hash_mix64)(CBenchmarkState& state)
+{
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        benchmark_do_not_optimize(mooon::utils::CHashUtils::mix64(i));
+    state.end();
+}
+
+MOOON_BENCHMARK(jump_consistent_hash_1000)(CBenchmarkState& state)
+{
+    state.begin();
+    for (uint64_t i=0; i<state.iterations(); ++i)
+        benchmark_do_not_optimize(mooon::utils::CHashUtils::jump_consistent_hash(i, 1000));
+    state.end();
+}
@@ -0,0 +1,371 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 基准测试的入口，用法示例：
+// mooon_bench --filter=queue,hash --cpu=2 --json=bench.json
+#include "benchmark.h"
+#include <mooon/sys/clock.h>
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/utils/string_utils.h>
+#include <mooon/utils/tokener.h>
+#include <algorithm>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+STRING_ARG_DEFINE(filter, "", "run benchmarks whose names contain any of the comma separated words, run all if empty");
+INTEGER_ARG_DEFINE(uint32_t, warmup, 200, 0, 60000, "milliseconds to warm up each benchmark");
+INTEGER_ARG_DEFINE(uint32_t, min_time, 1000, 10, 600000, "milliseconds to measure each benchmark");
+INTEGER_ARG_DEFINE(uint32_t, samples, 50, 5, 10000, "number of samples of each benchmark");
+INTEGER_ARG_DEFINE(int, cpu, -1, -1, 4095, "cpu to pin the process to, not pinned if -1");
+STRING_ARG_DEFINE(json, "", "file to write results in JSON, not written if empty");
+BOOL_STRING_ARG_DEFINE(perf, "false", "count cycles, instructions, cache misses, branch misses and context switches per op with perf_event_open");
+
+struct BenchmarkInfo
+{
+    const char* name;
+    benchmark_function_t function;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    uint64_t iterations; // 每个样本的迭代数
+    double mean;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    uint64_t perf_iterations;        // perf中计入的总迭代数
+    mooon::sys::perf_values_t perf;  // 所有样本的计数器之和，未指定--perf或不可用时为空
+};
+
+// 只在--perf=true时打开，所有基准测试在主线程中运行
+static mooon::sys::CPerfCounters sg_perf_counters;
+
+// 静态初始化的顺序不确定，所以用函数内的静态变量
+static std::vector<BenchmarkInfo>& get_benchmarks()
+{
+    static std::vector<BenchmarkInfo> benchmarks;
+    return benchmarks;
+}
+
+CBenchmarkRegistrar::CBenchmarkRegistrar(const char* name, benchmark_function_t function)
+{
+    BenchmarkInfo info = { name, function };
+    get_benchmarks().push_back(info);
+}
+
+CBenchmarkState::CBenchmarkState(uint64_t iterations, const mooon::sys::CPerfCounters* perf_counters)
+    : _iterations(iterations), _perf_counters(perf_counters), _begin_ns(0), _end_ns(0)
+{
+}
+
+// 读计数器在计时之外，读取本身的开销不计入耗时
+void CBenchmarkState::begin()
+{
+    if (_perf_counters != NULL)
+        (void)_perf_counters->read(&_begin_perf);
+    benchmark_clobber_memory();
+    _begin_ns = mooon::sys::CClock::get_nanoseconds();
+}
+
+void CBenchmarkState::end()
+{
+    _end_ns = mooon::sys::CClock::get_nanoseconds();
+    benchmark_clobber_memory();
+    if (_perf_counters != NULL)
+        (void)_perf_counters->read(&_end_perf);
+}
+
+uint64_t CBenchmarkState::get_nanoseconds() const
+{
+    return _end_ns - _begin_ns;
+}
+
+// 调用一次，返回每迭代的纳秒数，以及计时的纳秒数，perf不为NULL时累加计数器的增量
+static double run_once(benchmark_function_t function, uint64_t iterations, uint64_t* nanoseconds, mooon::sys::perf_values_t* perf=NULL)
+{
+    const mooon::sys::CPerfCounters* perf_counters = ((perf != NULL) && sg_perf_counters.is_open())? &sg_perf_counters: NULL;
+    CBenchmarkState state(iterations, perf_counters);
+    mooon::sys::perf_values_t begin_perf, end_perf;
+    if (perf_counters != NULL)
+        (void)perf_counters->read(&begin_perf);
+    const uint64_t begin_ns = mooon::sys::CClock::get_nanoseconds();
+    (*function)(state);
+    const uint64_t end_ns = mooon::sys::CClock::get_nanoseconds();
+    if (perf_counters != NULL)
+        (void)perf_counters->read(&end_perf);
+
+    // 没有调用begin和end时以整个调用计
+    if (perf_counters != NULL)
+        perf->add((0 == state.get_nanoseconds())? end_perf.sub(begin_perf): state.get_perf_values());
+    *nanoseconds = (0 == state.get_nanoseconds())? end_ns - begin_ns: state.get_nanoseconds();
+    if (0 == *nanoseconds)
+        *nanoseconds = 1;
+    return static_cast<double>(*nanoseconds) / iterations;
+}
+
+static double get_percentile(const std::vector<double>& sorted, double percentile)
+{
+    const size_t index = static_cast<size_t>(percentile / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size()-1)];
+}
+
+static BenchmarkResult run_benchmark(const BenchmarkInfo& info)
+{
+    const uint64_t sample_ns = static_cast<uint64_t>(mooon::argument::min_time->value()) * 1000000 / mooon::argument::samples->value();
+    const uint64_t warmup_ns = static_cast<uint64_t>(mooon::argument::warmup->value()) * 1000000;
+
+    // 逐步增加迭代数，直到一次调用约为sample_ns，同时作为预热
+    uint64_t iterations = 1;
+    uint64_t spent_ns = 0;
+    for (;;)
+    {
+        uint64_t nanoseconds;
+        (void)run_once(info.function, iterations, &nanoseconds);
+        spent_ns += nanoseconds;
+        if (nanoseconds >= sample_ns)
+            break;
+
+        const uint64_t scaled = iterations * sample_ns / nanoseconds;
+        iterations = std::min(std::max(scaled, iterations + 1), iterations * 10);
+    }
+    while (spent_ns < warmup_ns)
+    {
+        uint64_t nanoseconds;
+        (void)run_once(info.function, iterations, &nanoseconds);
+        spent_ns += nanoseconds;
+    }
+
+    BenchmarkResult result;
+    std::vector<double> samples;
+    double sum = 0;
+    for (uint32_t i=0; i<mooon::argument::samples->value(); ++i)
+    {
+        uint64_t nanoseconds;
+        samples.push_back(run_once(info.function, iterations, &nanoseconds, &result.perf));
+        sum += samples.back();
+    }
+    std::sort(samples.begin(), samples.end());
+
+    result.name = info.name;
+    result.iterations = iterations;
+    result.mean = sum / samples.size();
+    result.min = samples.front();
+    result.p50 = get_percentile(samples, 50);
+    result.p90 = get_percentile(samples, 90);
+    result.p99 = get_percentile(samples, 99);
+    result.max = samples.back();
+    result.perf_iterations = iterations * samples.size();
+    return result;
+}
+
+static double get_perf_per_op(const BenchmarkResult& r, mooon::sys::PerfEvent event)
+{
+    return static_cast<double>(r.perf.get(event)) / r.perf_iterations;
+}
+
+// 如："perf_per_op":{"cycles":12.345,"instructions":30.000,"ipc":2.430}，没有可用的计数器时为空
+static std::string get_perf_json(const BenchmarkResult& r)
+{
+    if (0 == r.perf.available)
+        return std::string();
+
+    std::string json;
+    char buffer[64];
+    for (int i=0; i<mooon::sys::PERF_EVENT_MAX; ++i)
+    {
+        const mooon::sys::PerfEvent event = static_cast<mooon::sys::PerfEvent>(i);
+        if (!r.perf.has(event))
+            continue;
+
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":%.3f", json.empty()? "": ",", mooon::sys::perf_values_t::get_name(event), get_perf_per_op(r, event));
+        json += buffer;
+    }
+    if (r.perf.has(mooon::sys::perf_cycles) && r.perf.has(mooon::sys::perf_instructions) && (r.perf.get(mooon::sys::perf_cycles) > 0))
+    {
+        snprintf(buffer, sizeof(buffer), ",\"ipc\":%.3f", static_cast<double>(r.perf.get(mooon::sys::perf_instructions)) / r.perf.get(mooon::sys::perf_cycles));
+        json += buffer;
+    }
+    return ",\"perf_per_op\":{" + json + "}";
+}
+
+// 可用的计数器名，如："cycles","instructions"
+static std::string get_perf_counters_json()
+{
+    std::string json;
+    for (int i=0; i<mooon::sys::PERF_EVENT_MAX; ++i)
+    {
+        if (sg_perf_counters.get_available() & (1U << i))
+            json += std::string(json.empty()? "\"": ",\"") + mooon::sys::perf_values_t::get_name(static_cast<mooon::sys::PerfEvent>(i)) + "\"";
+    }
+    return json;
+}
+
+static bool is_selected(const char* name, const std::vector<std::string>& words)
+{
+    if (words.empty())
+        return true;
+    for (std::vector<std::string>::size_type i=0; i<words.size(); ++i)
+    {
+        if (strstr(name, words[i].c_str()) != NULL)
+            return true;
+    }
+    return false;
+}
+
+static std::string get_cpu_model()
+{
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    if (NULL == fp)
+        return std::string();
+
+    char line[1024];
+    std::string model;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (0 == strncmp(line, "model name", 10))
+        {
+            const char* colon = strchr(line, ':');
+            if (colon != NULL)
+                model = mooon::utils::CStringUtils::trim(colon+1);
+            break;
+        }
+    }
+
+    fclose(fp);
+    return model;
+}
+
+static std::string escape_json(const std::string& str)
+{
+    std::string escaped;
+    for (std::string::size_type i=0; i<str.size(); ++i)
+    {
+        if (('"' == str[i]) || ('\\' == str[i]))
+            escaped += '\\';
+        escaped += str[i];
+    }
+    return escaped;
+}
+
+// 结果格式：{"context":{...},"benchmarks":[{"name":...,"iterations":...,"ns_per_op":{"mean":...},"perf_per_op":{"cycles":...}}]}，
+// 没有指定--perf或计数器不可用时没有perf_per_op
+static bool write_json(const std::string& filename, const std::vector<BenchmarkResult>& results)
+{
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (NULL == fp)
+        return false;
+
+    char hostname[256] = { '\0' };
+    (void)gethostname(hostname, sizeof(hostname)-1);
+#ifdef __OPTIMIZE__
+    const char* optimized = "true";
+#else
+    const char* optimized = "false";
+#endif
+
+    fprintf(fp, "{\n\"context\":{\"date\":\"%s\",\"host\":\"%s\",\"cpu_model\":\"%s\",\"cpu_number\":%d,\"pinned_cpu\":%d,"
+                "\"compiler\":\"%s\",\"optimized\":%s,\"warmup_ms\":%u,\"min_time_ms\":%u,\"samples\":%u,\"perf_counters\":[%s]},\n\"benchmarks\":[",
+            mooon::sys::CDatetimeUtils::get_current_datetime().c_str(), escape_json(hostname).c_str(),
+            escape_json(get_cpu_model()).c_str(), mooon::sys::CUtils::get_cpu_number(), mooon::argument::cpu->value(),
+            escape_json(__VERSION__).c_str(), optimized, mooon::argument::warmup->value(),
+            mooon::argument::min_time->value(), mooon::argument::samples->value(), get_perf_counters_json().c_str());
+    for (std::vector<BenchmarkResult>::size_type i=0; i<results.size(); ++i)
+    {
+        const BenchmarkResult& r = results[i];
+        fprintf(fp, "%s\n{\"name\":\"%s\",\"iterations\":%" PRIu64",\"ns_per_op\":"
+                    "{\"mean\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}%s}",
+                (0 == i)? "": ",", r.name.c_str(), r.iterations, r.mean, r.min, r.p50, r.p90, r.p99, r.max, get_perf_json(r).c_str());
+    }
+    fprintf(fp, "\n]}\n");
+
+    const bool ok = !ferror(fp);
+    return (0 == fclose(fp)) && ok;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    // 固定在一个CPU上运行，减少调度和频率差异带来的波动，基准测试创建的线程也继承这一设置
+    if (mooon::argument::cpu->value() >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(mooon::argument::cpu->value(), &cpu_set);
+        if (-1 == sched_setaffinity(0, sizeof(cpu_set), &cpu_set))
+        {
+            fprintf(stderr, "pin to cpu%d failed: %s\n", mooon::argument::cpu->value(), strerror(errno));
+            exit(1);
+        }
+    }
+
+    if (mooon::argument::perf->is_true() && !sg_perf_counters.open())
+        fprintf(stderr, "perf_event_open failed: %s, counters are not reported\n", strerror(errno));
+
+    std::vector<std::string> words;
+    mooon::utils::CTokener::split(&words, mooon::argument::filter->value(), ",", true);
+
+    std::vector<BenchmarkInfo> benchmarks = get_benchmarks();
+    std::sort(benchmarks.begin(), benchmarks.end(), [](const BenchmarkInfo& a, const BenchmarkInfo& b) { return strcmp(a.name, b.name) < 0; });
+
+    std::vector<BenchmarkResult> results;
+    fprintf(stdout, "%-40s %12s %10s %10s %10s %10s %10s %10s\n", "benchmark(ns/op)", "iterations", "mean", "min", "p50", "p90", "p99", "max");
+    for (std::vector<BenchmarkInfo>::size_type i=0; i<benchmarks.size(); ++i)
+    {
+        if (!is_selected(benchmarks[i].name, words))
+            continue;
+
+        const BenchmarkResult result = run_benchmark(benchmarks[i]);
+        fprintf(stdout, "%-40s %12" PRIu64" %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                result.name.c_str(), result.iterations, result.mean, result.min, result.p50, result.p90, result.p99, result.max);
+        if (result.perf.available != 0)
+        {
+            fprintf(stdout, "%-40s", "  per op:");
+            for (int j=0; j<mooon::sys::PERF_EVENT_MAX; ++j)
+            {
+                const mooon::sys::PerfEvent event = static_cast<mooon::sys::PerfEvent>(j);
+                if (result.perf.has(event))
+                    fprintf(stdout, " %s=%.3f", mooon::sys::perf_values_t::get_name(event), get_perf_per_op(result, event));
+            }
+            fprintf(stdout, "\n");
+        }
+        fflush(stdout);
+        results.push_back(result);
+    }
+
+    if (!mooon::argument::json->value().empty() && !write_json(mooon::argument::json->value(), results))
+    {
+        fprintf(stderr, "write %s failed: %s\n", mooon::argument::json->c_value(), strerror(errno));
+        exit(1);
+    }
+    return 0;
+}
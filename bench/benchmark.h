@@ -0,0 +1,100 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 微基准测试框架，每个基准测试由MOOON_BENCHMARK定义，链接在一起即自动注册：
+//
+// MOOON_BENCHMARK(array_queue_push_pop)(CBenchmarkState& state)
+// {
+//     mooon::utils::CArrayQueue<int> queue(1024); // 准备工作，不计时
+//     state.begin();
+//     for (uint64_t i=0; i<state.iterations(); ++i)
+//     {
+//         queue.push_back(i);
+//         benchmark_do_not_optimize(queue.pop_front());
+//     }
+//     state.end();
+// }
+//
+// 每个基准测试先预热并确定每次调用的迭代数，使一次调用约为min_time/samples毫秒，
+// 再调用samples次，每次得到一个每迭代的纳秒数，报告这些样本的均值、最小、最大和百分位数。
+// 指定--perf=true时，同时以CPerfCounters计每迭代的周期、指令、缓存未命中、分支预测失败和上下文切换数，
+// 计数器只计运行基准测试的线程，基准测试自己创建的线程不计入。
+#ifndef MOOON_BENCH_BENCHMARK_H
+#define MOOON_BENCH_BENCHMARK_H
+#include <mooon/sys/perf_counter.h>
+#include <stdint.h>
+#include <string>
+
+class CBenchmarkState
+{
+public:
+    /** perf_counters为NULL时不计硬件计数器 */
+    CBenchmarkState(uint64_t iterations, const mooon::sys::CPerfCounters* perf_counters=NULL);
+
+    /** 本次调用须执行的迭代数 */
+    uint64_t iterations() const { return _iterations; }
+
+    /***
+      * 开始和结束计时，之外的准备和清理工作不计入，
+      * 不调用时以整个调用计时
+      */
+    void begin();
+    void end();
+
+    /** 得到计时的纳秒数 */
+    uint64_t get_nanoseconds() const;
+
+    /** 得到begin和end之间的计数器增量 */
+    mooon::sys::perf_values_t get_perf_values() const { return _end_perf.sub(_begin_perf); }
+
+private:
+    const uint64_t _iterations;
+    const mooon::sys::CPerfCounters* _perf_counters;
+    uint64_t _begin_ns;
+    uint64_t _end_ns;
+    mooon::sys::perf_values_t _begin_perf;
+    mooon::sys::perf_values_t _end_perf;
+};
+
+typedef void (*benchmark_function_t)(CBenchmarkState& state);
+
+class CBenchmarkRegistrar
+{
+public:
+    CBenchmarkRegistrar(const char* name, benchmark_function_t function);
+};
+
+// 阻止编译器优化掉value的计算
+template <typename T>
+inline void benchmark_do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// 阻止编译器跨过这一点重排或省略内存读写
+inline void benchmark_clobber_memory()
+{
+    asm volatile("" : : : "memory");
+}
+
+#define MOOON_BENCHMARK(name) \
+    static void benchmark_##name(CBenchmarkState& state); \
+    static CBenchmarkRegistrar sg_benchmark_##name##_registrar(#name, benchmark_##name); \
+    static void benchmark_##name
+
+#endif // MOOON_BENCH_BENCHMARK_H
@@ -0,0 +1,262 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "echo_server.h"
+#include <mooon/sys/log.h>
+#include <errno.h>
+#include <string>
+#include <sys/socket.h>
+
+#define ECHO_BUFFER_SIZE   65536
+#define ECHO_ACCEPT_BATCH  64
+
+// 每个循环线程一个接收缓冲区，读到的数据立即发回，只有发不完的部分才复制到连接中
+static __thread char sg_echo_buffer[ECHO_BUFFER_SIZE];
+
+class CEchoConnection: public mooon::net::CEpollable
+{
+public:
+    CEchoConnection(int fd, CEchoServer* server)
+        : _server(server), _pending_offset(0)
+    {
+        set_fd(fd);
+        __atomic_add_fetch(&_server->_connection_number, 1, __ATOMIC_RELAXED);
+    }
+
+    ~CEchoConnection()
+    {
+        __atomic_sub_fetch(&_server->_connection_number, 1, __ATOMIC_RELAXED);
+    }
+
+private:
+    virtual mooon::net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+    int flush();
+    int echo(const char* data, size_t size);
+
+private:
+    CEchoServer* _server;
+    std::string _pending;   /** 未发完的数据 */
+    size_t _pending_offset; /** _pending中已发送的字节数 */
+};
+
+// 返回1表示已全部发出，0表示须等可写，-1表示出错
+int CEchoConnection::flush()
+{
+    while (_pending_offset < _pending.size())
+    {
+        const ssize_t n = ::send(get_fd(), _pending.data()+_pending_offset, _pending.size()-_pending_offset, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            _pending_offset += static_cast<size_t>(n);
+            __atomic_add_fetch(&_server->_echoed_bytes, n, __ATOMIC_RELAXED);
+        }
+        else if (EINTR == errno)
+            continue;
+        else
+            return ((EAGAIN == errno) || (EWOULDBLOCK == errno))? 0: -1;
+    }
+
+    _pending.clear();
+    _pending_offset = 0;
+    return 1;
+}
+
+int CEchoConnection::echo(const char* data, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size)
+    {
+        const ssize_t n = ::send(get_fd(), data+offset, size-offset, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            offset += static_cast<size_t>(n);
+            __atomic_add_fetch(&_server->_echoed_bytes, n, __ATOMIC_RELAXED);
+        }
+        else if (EINTR == errno)
+            continue;
+        else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            break;
+        else
+            return -1;
+    }
+    if (offset == size)
+        return 1;
+
+    _pending.assign(data+offset, size-offset);
+    _pending_offset = 0;
+    return 0;
+}
+
+mooon::net::epoll_event_t CEchoConnection::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    const uint32_t budget_bytes = static_cast<mooon::net::CEventLoop*>(input_ptr)->get_io_budget(this).bytes;
+    size_t received_bytes = 0;
+
+    // 积压的数据发完之前不读，由TCP的流控反压客户端
+    int result = flush();
+    if (result != 1)
+        return (0 == result)? mooon::net::epoll_write: mooon::net::epoll_close;
+
+    for (;;)
+    {
+        if ((budget_bytes > 0) && (received_bytes >= budget_bytes))
+            return mooon::net::epoll_again;
+
+        const ssize_t n = ::recv(get_fd(), sg_echo_buffer, sizeof(sg_echo_buffer), 0);
+        if (0 == n)
+            return mooon::net::epoll_close;
+        if (n < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            return ((EAGAIN == errno) || (EWOULDBLOCK == errno))? mooon::net::epoll_read: mooon::net::epoll_close;
+        }
+
+        received_bytes += static_cast<size_t>(n);
+        result = echo(sg_echo_buffer, static_cast<size_t>(n));
+        if (result != 1)
+            return (0 == result)? mooon::net::epoll_write: mooon::net::epoll_close;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 每个事件循环的监听分片，accept到的连接交给本循环
+class CEchoListener: public mooon::net::CListener
+{
+public:
+    CEchoListener(): _server(NULL) {}
+
+    void attach(CEchoServer* server) { _server = server; }
+
+private:
+    virtual mooon::net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    CEchoServer* _server;
+};
+
+mooon::net::epoll_event_t CEchoListener::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    mooon::net::CEventLoop* event_loop = static_cast<mooon::net::CEventLoop*>(input_ptr);
+    mooon::net::accepted_t accepted_array[ECHO_ACCEPT_BATCH];
+
+    try
+    {
+        int number;
+        do
+        {
+            number = accept_batch(accepted_array, ECHO_ACCEPT_BATCH);
+            for (int i=0; i<number; ++i)
+            {
+                mooon::net::set_nodelay(accepted_array[i].fd, true);
+                CEchoConnection* connection = new CEchoConnection(accepted_array[i].fd, _server);
+                try
+                {
+                    event_loop->add(connection, EPOLLIN);
+                    __atomic_add_fetch(&_server->_accepted_number, 1, __ATOMIC_RELAXED);
+                }
+                catch (mooon::sys::CSyscallException& ex)
+                {
+                    MYLOG_ERROR("loop[%d] add echo connection error: %s\n", event_loop->get_index(), ex.str().c_str());
+                    connection->close();
+                    delete connection;
+                }
+            }
+        } while (ECHO_ACCEPT_BATCH == number);
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        // 如文件句柄用完，监听者本身仍然有效
+        MYLOG_ERROR("loop[%d] echo accept error: %s\n", event_loop->get_index(), ex.str().c_str());
+    }
+
+    return mooon::net::epoll_none;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 在循环线程中设置预算并开始监听
+class CEchoStartTask: public mooon::net::ILoopTask
+{
+public:
+    CEchoStartTask(CEchoListener* listener, uint32_t budget_bytes)
+        : _listener(listener), _budget_bytes(budget_bytes)
+    {
+    }
+
+private:
+    virtual void execute(mooon::net::CEventLoop* event_loop)
+    {
+        event_loop->set_io_budget(_budget_bytes, 0);
+        event_loop->add(_listener, EPOLLIN);
+    }
+
+private:
+    CEchoListener* _listener;
+    uint32_t _budget_bytes;
+};
+
+CEchoServer::CEchoServer()
+    : _listen_manager(NULL), _accepted_number(0), _connection_number(0), _echoed_bytes(0)
+{
+}
+
+CEchoServer::~CEchoServer()
+{
+    stop();
+}
+
+void CEchoServer::start(const mooon::net::ip_address_t& ip, uint16_t port, uint16_t loop_number, bool pin_cpu, uint32_t budget_bytes)
+{
+    if (0 == loop_number)
+        loop_number = mooon::sys::CUtils::get_cpu_number();
+    if (0 == loop_number)
+        loop_number = 1;
+
+    try
+    {
+        _reactor_pool.create(loop_number, 10000, pin_cpu);
+        _listen_manager = new mooon::net::CListenManager<CEchoListener>;
+        _listen_manager->add(ip, port);
+        _listen_manager->create(true, loop_number);
+
+        for (uint16_t i=0; i<loop_number; ++i)
+        {
+            // 监听者属于CListenManager的数组，保持一个引用，使事件循环剔除它时不会将其销毁
+            CEchoListener* listener = _listen_manager->get_listener(0, i);
+            listener->inc_refcount();
+            listener->attach(this);
+            _reactor_pool.get_loop(i)->post(new CEchoStartTask(listener, budget_bytes));
+        }
+    }
+    catch (...)
+    {
+        stop();
+        throw;
+    }
+}
+
+void CEchoServer::stop()
+{
+    _reactor_pool.destroy();
+    if (_listen_manager != NULL)
+    {
+        _listen_manager->destroy();
+        delete _listen_manager;
+        _listen_manager = NULL;
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_BENCH_NET_ECHO_SERVER_H
+#define MOOON_BENCH_NET_ECHO_SERVER_H
+#include <mooon/net/event_loop.h>
+#include <mooon/net/listen_manager.h>
+#include <mooon/net/listener.h>
+
+class CEchoListener;
+
+/***
+  * 基于CListenManager和CReactorPool的回显服务端，收到的字节原样发回，不做分帧，
+  * 所以任何按字节回显的客户端（包括其它实现的压测工具）都可以使用。
+  *
+  * 每个事件循环一个SO_REUSEPORT监听分片，accept到的连接留在本循环，
+  * 读到的数据立即发回，发不完时缓存剩余部分并改为等可写，发完之前不再读，
+  * 使得客户端不读应答时由TCP的流控反压，而不是在服务端无限堆积。
+  * 读取遵从CEventLoop的预算（set_io_budget），连接之间公平。
+  *
+  * stop时未关闭的连接不逐个剔除，它们随进程退出释放，只用于压测。
+  */
+class CEchoServer
+{
+    friend class CEchoListener;
+    friend class CEchoConnection;
+
+public:
+    CEchoServer();
+    ~CEchoServer();
+
+    /***
+      * 启动监听和事件循环
+      * @loop_number: 事件循环个数，也是监听分片数，为0时取CPU个数
+      * @pin_cpu: 是否将事件循环绑定到CPU
+      * @budget_bytes: 每个连接每次最多读取的字节数，为0表示读到EAGAIN为止
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void start(const mooon::net::ip_address_t& ip, uint16_t port, uint16_t loop_number, bool pin_cpu, uint32_t budget_bytes=0);
+    void stop();
+
+    uint16_t get_loop_number() const { return _reactor_pool.get_loop_number(); }
+
+    /** 得到累计接受的连接数和当前的连接数 */
+    uint64_t get_accepted_number() const { return __atomic_load_n(&_accepted_number, __ATOMIC_RELAXED); }
+    int64_t get_connection_number() const { return __atomic_load_n(&_connection_number, __ATOMIC_RELAXED); }
+
+    /** 得到累计回显的字节数 */
+    uint64_t get_echoed_bytes() const { return __atomic_load_n(&_echoed_bytes, __ATOMIC_RELAXED); }
+
+private:
+    mooon::net::CReactorPool _reactor_pool;
+    mooon::net::CListenManager<CEchoListener>* _listen_manager;
+    uint64_t _accepted_number;
+    int64_t _connection_number;
+    uint64_t _echoed_bytes;
+};
+
+#endif // MOOON_BENCH_NET_ECHO_SERVER_H
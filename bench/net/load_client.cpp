@@ -0,0 +1,383 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "load_client.h"
+#include <mooon/net/event_loop.h>
+#include <mooon/net/tcp_client.h>
+#include <mooon/net/tcp_client_pool.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
+#include <algorithm>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define PAYLOAD_VARIANTS    256     // 每条消息从模式缓冲区的不同偏移开始，相邻消息的内容不同
+#define RECEIVE_BUFFER_SIZE 65536
+#define POLL_MILLISECONDS   100
+#define DRAIN_MILLISECONDS  3000    // 停止后等待在途消息回显的最长毫秒数
+
+// 发压的阶段，由主线程切换
+#define PHASE_WARMUP    0
+#define PHASE_MEASURE   1
+#define PHASE_STOP      2
+
+bool get_payload_pattern(const std::string& name, payload_pattern_t* pattern)
+{
+    if ("zero" == name)
+        *pattern = payload_zero;
+    else if ("sequence" == name)
+        *pattern = payload_sequence;
+    else if ("random" == name)
+        *pattern = payload_random;
+    else
+        return false;
+    return true;
+}
+
+const char* get_payload_pattern_name(payload_pattern_t pattern)
+{
+    if (payload_sequence == pattern)
+        return "sequence";
+    if (payload_random == pattern)
+        return "random";
+    return "zero";
+}
+
+load_config_t::load_config_t()
+    : connections(1), threads(1), message_size(64), depth(1), pattern(payload_zero), verify(false), use_pool(true),
+      connect_timeout_ms(3000), warmup_ms(1000), duration_ms(5000)
+{
+}
+
+load_result_t::load_result_t()
+    : messages(0), bytes(0), errors(0), elapsed_seconds(0)
+{
+}
+
+struct LoadConnection
+{
+    mooon::net::CTcpClient* client;
+    uint64_t send_number;              // 已开始发送的消息数
+    uint64_t receive_number;           // 已收齐回显的消息数
+    uint32_t send_offset;              // 当前消息已发送的字节数
+    uint32_t receive_offset;           // 当前消息已收到的字节数
+    std::vector<uint64_t> send_times;  // 在途消息开始发送的时间，以消息序号%depth为下标
+    bool broken;
+
+    bool is_idle() const { return (send_number == receive_number) && (0 == send_offset); }
+};
+
+struct LoadContext
+{
+    const load_config_t* config;
+    const char* payload;                      // 大小为message_size+PAYLOAD_VARIANTS
+    volatile int* phase;
+    mooon::sys::CLatencyHistogram* latency;
+    std::vector<LoadConnection*> connections;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t errors;
+};
+
+static const char* get_payload(const LoadContext* context, uint64_t number)
+{
+    if (payload_zero == context->config->pattern)
+        return context->payload;
+    return context->payload + number % PAYLOAD_VARIANTS;
+}
+
+// 在depth的限制内尽量多发，返回是否还有数据要发（须等可写）
+static bool send_messages(LoadContext* context, LoadConnection* connection, bool stopping)
+{
+    const uint32_t message_size = context->config->message_size;
+    const uint32_t depth = context->config->depth;
+
+    for (;;)
+    {
+        if (0 == connection->send_offset)
+        {
+            // 停止后只发完已开始的消息
+            if (stopping || (connection->send_number - connection->receive_number >= depth))
+                return false;
+            connection->send_times[connection->send_number % depth] = mooon::sys::CClock::get_nanoseconds();
+        }
+
+        const char* payload = get_payload(context, connection->send_number);
+        const ssize_t n = connection->client->send(payload+connection->send_offset, message_size-connection->send_offset);
+        if (n <= 0)
+            return true;
+
+        connection->send_offset += static_cast<uint32_t>(n);
+        if (connection->send_offset == message_size)
+        {
+            ++connection->send_number;
+            connection->send_offset = 0;
+        }
+    }
+}
+
+// 读完内核中的回显，每收齐一条消息记录一次延迟，返回false表示连接已断开或内容不符
+static bool receive_messages(LoadContext* context, LoadConnection* connection, char* buffer)
+{
+    const uint32_t message_size = context->config->message_size;
+    const uint32_t depth = context->config->depth;
+
+    for (;;)
+    {
+        const ssize_t n = connection->client->receive(buffer, RECEIVE_BUFFER_SIZE);
+        if (0 == n)
+            return false;
+        if (n < 0)
+            return true;
+
+        const uint64_t now = mooon::sys::CClock::get_nanoseconds();
+        const bool measuring = (PHASE_MEASURE == *context->phase);
+        for (size_t consumed=0; consumed<static_cast<size_t>(n);)
+        {
+            const size_t size = std::min(static_cast<size_t>(message_size - connection->receive_offset), static_cast<size_t>(n) - consumed);
+            if (connection->receive_number >= connection->send_number + ((connection->send_offset > 0)? 1: 0))
+                return false; // 收到的比发出的多
+            if (context->config->verify
+             && (memcmp(buffer+consumed, get_payload(context, connection->receive_number)+connection->receive_offset, size) != 0))
+                return false;
+
+            consumed += size;
+            connection->receive_offset += static_cast<uint32_t>(size);
+            if (connection->receive_offset == message_size)
+            {
+                if (measuring)
+                {
+                    context->latency->record(now - connection->send_times[connection->receive_number % depth]);
+                    ++context->messages;
+                    context->bytes += message_size;
+                }
+                ++connection->receive_number;
+                connection->receive_offset = 0;
+            }
+        }
+    }
+}
+
+static void* load_thread(void* param)
+{
+    LoadContext* context = static_cast<LoadContext*>(param);
+    std::vector<struct pollfd> fds(context->connections.size());
+    std::vector<char> buffer(RECEIVE_BUFFER_SIZE);
+    std::vector<bool> want_write(context->connections.size(), true);
+    uint64_t drain_deadline = 0;
+
+    for (;;)
+    {
+        const bool stopping = (PHASE_STOP == *context->phase);
+        if (stopping && (0 == drain_deadline))
+            drain_deadline = mooon::sys::CClock::get_milliseconds() + DRAIN_MILLISECONDS;
+
+        uint32_t active_number = 0;
+        for (std::vector<LoadConnection*>::size_type i=0; i<context->connections.size(); ++i)
+        {
+            LoadConnection* connection = context->connections[i];
+            if (connection->broken)
+                continue;
+
+            try
+            {
+                if ((0 == fds[i].revents) || receive_messages(context, connection, &buffer[0]))
+                    want_write[i] = send_messages(context, connection, stopping);
+                else
+                    connection->broken = true;
+            }
+            catch (mooon::sys::CSyscallException& ex)
+            {
+                connection->broken = true;
+            }
+
+            if (connection->broken)
+                ++context->errors;
+            else if (!stopping || !connection->is_idle())
+                ++active_number;
+        }
+
+        // 停止后等在途的消息都收齐，或超时
+        if ((0 == active_number) || (stopping && (mooon::sys::CClock::get_milliseconds() >= drain_deadline)))
+            break;
+
+        for (std::vector<LoadConnection*>::size_type i=0; i<context->connections.size(); ++i)
+        {
+            LoadConnection* connection = context->connections[i];
+            fds[i].fd = connection->broken? -1: connection->client->get_fd();
+            fds[i].events = POLLIN | (want_write[i]? POLLOUT: 0);
+            fds[i].revents = 0;
+        }
+        if ((-1 == poll(&fds[0], fds.size(), POLL_MILLISECONDS)) && (errno != EINTR))
+            break;
+    }
+
+    return NULL;
+}
+
+static void fill_payload(payload_pattern_t pattern, std::vector<char>* payload)
+{
+    for (std::vector<char>::size_type i=0; i<payload->size(); ++i)
+    {
+        if (payload_sequence == pattern)
+            (*payload)[i] = static_cast<char>(i);
+        else if (payload_random == pattern)
+            (*payload)[i] = static_cast<char>(random());
+        else
+            (*payload)[i] = '\0';
+    }
+}
+
+bool run_load(const load_config_t& config, load_result_t* result, std::string* errmsg)
+{
+    const uint32_t connection_number = std::max(config.connections, 1u);
+    const uint32_t thread_number = std::min(std::max(config.threads, 1u), connection_number);
+    mooon::net::CReactorPool reactor_pool;
+    mooon::net::CTcpClientPool* client_pool = NULL;
+    std::vector<LoadConnection> connections(connection_number);
+    uint32_t connected_number = 0;
+    bool ok = true;
+
+    if (config.use_pool)
+    {
+        // 连接池在事件循环中以非阻塞方式建立连接
+        reactor_pool.create(1, 100, false);
+        client_pool = new mooon::net::CTcpClientPool(reactor_pool.get_loop(0), 0, connection_number, connection_number);
+        client_pool->set_connect_timeout_milliseconds(config.connect_timeout_ms);
+        client_pool->create(connection_number);
+        client_pool->add_node(config.peer);
+    }
+    for (; connected_number<connection_number; ++connected_number)
+    {
+        LoadConnection* connection = &connections[connected_number];
+        connection->send_number = 0;
+        connection->receive_number = 0;
+        connection->send_offset = 0;
+        connection->receive_offset = 0;
+        connection->send_times.resize(std::max(config.depth, 1u));
+        connection->broken = false;
+
+        try
+        {
+            if (client_pool != NULL)
+            {
+                connection->client = client_pool->borrow(config.peer, config.connect_timeout_ms);
+                if (NULL == connection->client)
+                {
+                    *errmsg = mooon::utils::CStringUtils::format_string("connection %u: connect timeout", connected_number);
+                    break;
+                }
+            }
+            else
+            {
+                connection->client = new mooon::net::CTcpClient;
+                connection->client->set_peer(config.peer);
+                connection->client->set_connect_timeout_milliseconds(config.connect_timeout_ms);
+                connection->client->timed_connect();
+                connection->client->set_nonblock(true);
+            }
+            connection->client->set_nodelay(true);
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            *errmsg = mooon::utils::CStringUtils::format_string("connection %u: %s", connected_number, ex.str().c_str());
+            if (NULL == client_pool)
+                delete connection->client;
+            else
+                client_pool->pay_back(connection->client, true);
+            break;
+        }
+    }
+
+    if (connected_number == connection_number)
+    {
+        load_config_t thread_config = config;
+        thread_config.depth = std::max(config.depth, 1u);
+        thread_config.message_size = std::max(config.message_size, 1u);
+        std::vector<char> payload(thread_config.message_size + PAYLOAD_VARIANTS);
+        fill_payload(config.pattern, &payload);
+
+        volatile int phase = PHASE_WARMUP;
+        mooon::sys::CLatencyHistogram latency;
+        std::vector<LoadContext> contexts(thread_number);
+        std::vector<pthread_t> threads(thread_number);
+        for (uint32_t i=0; i<thread_number; ++i)
+        {
+            contexts[i].config = &thread_config;
+            contexts[i].payload = &payload[0];
+            contexts[i].phase = &phase;
+            contexts[i].latency = &latency;
+            contexts[i].messages = 0;
+            contexts[i].bytes = 0;
+            contexts[i].errors = 0;
+        }
+        for (uint32_t i=0; i<connection_number; ++i)
+            contexts[i % thread_number].connections.push_back(&connections[i]);
+        for (uint32_t i=0; i<thread_number; ++i)
+            (void)pthread_create(&threads[i], NULL, load_thread, &contexts[i]);
+
+        mooon::sys::CUtils::millisleep(config.warmup_ms);
+        const uint64_t begin_ns = mooon::sys::CClock::get_nanoseconds();
+        __atomic_store_n(&phase, PHASE_MEASURE, __ATOMIC_RELAXED);
+        mooon::sys::CUtils::millisleep(config.duration_ms);
+        __atomic_store_n(&phase, PHASE_STOP, __ATOMIC_RELAXED);
+        result->elapsed_seconds = static_cast<double>(mooon::sys::CClock::get_nanoseconds() - begin_ns) / 1000000000;
+
+        for (uint32_t i=0; i<thread_number; ++i)
+        {
+            (void)pthread_join(threads[i], NULL);
+            result->messages += contexts[i].messages;
+            result->bytes += contexts[i].bytes;
+            result->errors += contexts[i].errors;
+        }
+        latency.get_snapshot(&result->latency);
+        if (result->errors > 0)
+            *errmsg = mooon::utils::CStringUtils::format_string("%" PRIu64" connections broken or echoed mismatched data", result->errors);
+    }
+    else
+    {
+        ok = false;
+    }
+
+    for (uint32_t i=0; i<connected_number; ++i)
+    {
+        if (NULL == client_pool)
+        {
+            connections[i].client->close();
+            delete connections[i].client;
+        }
+        else
+        {
+            // 可能还有未读的回显，不放回空闲列表
+            client_pool->pay_back(connections[i].client, true);
+        }
+    }
+    if (client_pool != NULL)
+    {
+        client_pool->destroy();
+        delete client_pool;
+    }
+    reactor_pool.destroy();
+    return ok;
+}
@@ -0,0 +1,77 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_BENCH_NET_LOAD_CLIENT_H
+#define MOOON_BENCH_NET_LOAD_CLIENT_H
+#include <mooon/net/ip_node.h>
+#include <mooon/sys/metrics.h>
+#include <string>
+
+/** 消息内容的模式 */
+typedef enum
+{
+    payload_zero     = 0, /** 全0，压缩或比较友好的最好情况 */
+    payload_sequence = 1, /** 按字节递增，每条消息的起点不同，便于定位错乱的位置 */
+    payload_random   = 2  /** 随机字节，每条消息取随机池中不同的一段 */
+}payload_pattern_t;
+
+/** 由名字（zero、sequence或random）得到模式，不认识的名字返回false */
+bool get_payload_pattern(const std::string& name, payload_pattern_t* pattern);
+const char* get_payload_pattern_name(payload_pattern_t pattern);
+
+typedef struct load_config_t
+{
+    mooon::net::ip_node_t peer;
+    uint32_t connections;        /** 连接数，平均分给各线程 */
+    uint32_t threads;            /** 发压线程数，不超过连接数 */
+    uint32_t message_size;       /** 每条消息的字节数 */
+    uint32_t depth;              /** 每个连接在途（已发出未收到回显）的最多消息数，为1时即一问一答 */
+    payload_pattern_t pattern;
+    bool verify;                 /** 是否逐字节校验回显的内容 */
+    bool use_pool;               /** 是否经CTcpClientPool建立连接，否则每个连接直接CTcpClient::timed_connect */
+    uint32_t connect_timeout_ms;
+    uint32_t warmup_ms;          /** 预热的毫秒数，期间的消息不计入结果 */
+    uint32_t duration_ms;        /** 计入结果的毫秒数 */
+
+    load_config_t();
+}load_config_t;
+
+typedef struct load_result_t
+{
+    uint64_t messages;           /** 计入结果的消息数，即收到完整回显的 */
+    uint64_t bytes;              /** 计入结果的回显字节数（单方向） */
+    uint64_t errors;             /** 断开或校验失败的连接数 */
+    double elapsed_seconds;      /** 计入结果的实际时长 */
+    mooon::sys::CHistogramSnapshot latency; /** 每条消息从开始发送到收齐回显的纳秒数 */
+
+    load_result_t();
+}load_result_t;
+
+/***
+  * 回显服务端的发压客户端：每个连接保持depth条消息在途，收齐一条回显即补发一条（闭环），
+  * 所以吞吐和延迟受服务端的处理能力约束，depth越大越接近带宽上限，为1时度量的是往返延迟。
+  * 消息按发送的顺序回显，回显字节数每满message_size即完成最早的一条在途消息。
+  *
+  * 连接被设置为非阻塞，由每个线程以poll驱动自己的连接，发送和接收交替进行，
+  * depth*message_size超过套接字缓冲区时也不会互相等待而死锁。
+  *
+  * @return: 所有连接都建立成功返回true，否则errmsg为原因
+  */
+bool run_load(const load_config_t& config, load_result_t* result, std::string* errmsg);
+
+#endif // MOOON_BENCH_NET_LOAD_CLIENT_H
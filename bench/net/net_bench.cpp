@@ -0,0 +1,243 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 网络栈的回显基准测试，服务端基于CListenManager和CReactorPool，客户端基于CTcpClient和CTcpClientPool，
+// 同一进程内跑本机回环，或服务端和客户端分别在不同的机器上运行：
+// mooon_net_bench --mode=loopback --connections=8 --threads=2 --size=1024 --depth=16 --json=net.json
+// mooon_net_bench --mode=server --ip=192.168.1.2 --port=2016 --loops=4
+// mooon_net_bench --mode=client --ip=192.168.1.2 --port=2016 --connections=64 --threads=4 --pattern=random --verify=true
+#include "echo_server.h"
+#include "load_client.h"
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/utils/json_writer.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+STRING_ARG_DEFINE(mode, "loopback", "server, client, or loopback which runs both in one process");
+STRING_ARG_DEFINE(ip, "127.0.0.1", "IP the server listens on (not 0.0.0.0, which CListener forbids), or the client connects to");
+INTEGER_ARG_DEFINE(uint16_t, port, 2016, 1, 65535, "port the server listens on, or the client connects to");
+INTEGER_ARG_DEFINE(uint16_t, loops, 1, 0, 1024, "event loops (and SO_REUSEPORT listen shards) of the server, the number of CPUs if 0");
+BOOL_STRING_ARG_DEFINE(pin_cpu, "false", "pin the server's event loops to CPUs");
+INTEGER_ARG_DEFINE(uint32_t, budget, 0, 0, 104857600, "bytes the server reads from a connection per event, unlimited if 0");
+INTEGER_ARG_DEFINE(uint32_t, connections, 1, 1, 100000, "connections of the client");
+INTEGER_ARG_DEFINE(uint32_t, threads, 1, 1, 1024, "threads of the client, connections are spread over them");
+INTEGER_ARG_DEFINE(uint32_t, size, 64, 1, 67108864, "bytes of a message");
+INTEGER_ARG_DEFINE(uint32_t, depth, 1, 1, 65536, "messages in flight per connection, 1 for request-response");
+STRING_ARG_DEFINE(pattern, "zero", "payload pattern: zero, sequence or random");
+BOOL_STRING_ARG_DEFINE(verify, "false", "verify every echoed byte");
+BOOL_STRING_ARG_DEFINE(pool, "true", "connect through CTcpClientPool, otherwise by CTcpClient::timed_connect");
+INTEGER_ARG_DEFINE(uint32_t, connect_timeout, 3000, 1, 600000, "milliseconds to connect");
+INTEGER_ARG_DEFINE(uint32_t, warmup, 1000, 0, 600000, "milliseconds to warm up, not counted");
+INTEGER_ARG_DEFINE(uint32_t, duration, 5000, 10, 86400000, "milliseconds to measure");
+STRING_ARG_DEFINE(json, "", "file to write the client's result in JSON, not written if empty");
+
+static void print_result(const load_result_t& result)
+{
+    const double seconds = (result.elapsed_seconds > 0)? result.elapsed_seconds: 1;
+    const mooon::sys::CHistogramSnapshot& latency = result.latency;
+
+    fprintf(stdout, "messages: %" PRIu64", %.1f/s, %.3f MiB/s, errors: %" PRIu64"\n",
+            result.messages, result.messages / seconds, result.bytes / seconds / 1048576, result.errors);
+    fprintf(stdout, "latency(us): mean=%.1f min=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+            latency.get_mean() / 1000.0, latency.get_min() / 1000.0, latency.get_percentile(50) / 1000.0,
+            latency.get_percentile(90) / 1000.0, latency.get_percentile(99) / 1000.0,
+            latency.get_percentile(99.9) / 1000.0, latency.get_max() / 1000.0);
+}
+
+// 结果格式：{"context":{...},"result":{"messages":...,"messages_per_second":...,"latency_ns":{"mean":...}}}，
+// 与mooon_bench一样在context中记录机器和编译的信息，便于比较不同版本的结果
+static bool write_json(const std::string& filename, const load_config_t& config, const load_result_t& result)
+{
+    char hostname[256] = { '\0' };
+    (void)gethostname(hostname, sizeof(hostname)-1);
+#ifdef __OPTIMIZE__
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+#endif
+    const double seconds = (result.elapsed_seconds > 0)? result.elapsed_seconds: 1;
+    const bool loopback = (mooon::argument::mode->value() == "loopback");
+
+    std::string json;
+    {
+        mooon::utils::CJsonWriter writer(&json);
+        writer.begin_object();
+        writer.key("context").begin_object();
+        writer.key("date").value(mooon::sys::CDatetimeUtils::get_current_datetime());
+        writer.key("host").value(hostname);
+        writer.key("cpu_number").value(mooon::sys::CUtils::get_cpu_number());
+        writer.key("compiler").value(__VERSION__);
+        writer.key("optimized").value(optimized);
+        writer.key("mode").value(mooon::argument::mode->value());
+        writer.key("peer").value(config.peer.ip.to_string() + ":" + mooon::utils::CStringUtils::int_tostring(config.peer.port));
+        if (loopback)
+            writer.key("server_loops").value(static_cast<uint32_t>(mooon::argument::loops->value()));
+        writer.key("connections").value(config.connections);
+        writer.key("threads").value(config.threads);
+        writer.key("message_size").value(config.message_size);
+        writer.key("depth").value(config.depth);
+        writer.key("pattern").value(get_payload_pattern_name(config.pattern));
+        writer.key("verify").value(config.verify);
+        writer.key("pool").value(config.use_pool);
+        writer.key("warmup_ms").value(config.warmup_ms);
+        writer.key("duration_ms").value(config.duration_ms);
+        writer.end_object();
+
+        writer.key("result").begin_object();
+        writer.key("messages").value(result.messages);
+        writer.key("bytes").value(result.bytes);
+        writer.key("errors").value(result.errors);
+        writer.key("elapsed_seconds").value(result.elapsed_seconds);
+        writer.key("messages_per_second").value(result.messages / seconds);
+        writer.key("bytes_per_second").value(result.bytes / seconds);
+        writer.key("latency_ns").begin_object();
+        writer.key("mean").value(result.latency.get_mean());
+        writer.key("min").value(result.latency.get_min());
+        writer.key("p50").value(result.latency.get_percentile(50));
+        writer.key("p90").value(result.latency.get_percentile(90));
+        writer.key("p99").value(result.latency.get_percentile(99));
+        writer.key("p999").value(result.latency.get_percentile(99.9));
+        writer.key("max").value(result.latency.get_max());
+        writer.end_object();
+        writer.end_object();
+        writer.end_object();
+    }
+    json += "\n";
+
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (NULL == fp)
+        return false;
+    const bool ok = (fwrite(json.data(), 1, json.size(), fp) == json.size());
+    return (0 == fclose(fp)) && ok;
+}
+
+// 以服务端运行，每秒输出连接数和回显的带宽，直到收到SIGINT或SIGTERM
+static void run_server(const mooon::net::ip_address_t& ip)
+{
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    (void)pthread_sigmask(SIG_BLOCK, &sigset, NULL); // 在事件循环线程创建之前，使它们继承
+
+    CEchoServer server;
+    server.start(ip, mooon::argument::port->value(), mooon::argument::loops->value(),
+                 mooon::argument::pin_cpu->is_true(), mooon::argument::budget->value());
+    fprintf(stdout, "echo server listening on %s:%u with %u loops\n",
+            ip.to_string().c_str(), mooon::argument::port->value(), server.get_loop_number());
+
+    uint64_t last_bytes = 0;
+    struct timespec timeout = { 1, 0 };
+    while (-1 == sigtimedwait(&sigset, NULL, &timeout))
+    {
+        const uint64_t bytes = server.get_echoed_bytes();
+        fprintf(stdout, "connections: %" PRId64", accepted: %" PRIu64", echoed: %.3f MiB/s\n",
+                server.get_connection_number(), server.get_accepted_number(), (bytes - last_bytes) / 1048576.0);
+        fflush(stdout);
+        last_bytes = bytes;
+    }
+    server.stop();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    const std::string& mode = mooon::argument::mode->value();
+    if ((mode != "server") && (mode != "client") && (mode != "loopback"))
+    {
+        fprintf(stderr, "unknown mode: %s\n", mode.c_str());
+        exit(1);
+    }
+
+    load_config_t config;
+    if (!get_payload_pattern(mooon::argument::pattern->value(), &config.pattern))
+    {
+        fprintf(stderr, "unknown pattern: %s\n", mooon::argument::pattern->c_value());
+        exit(1);
+    }
+
+    // 对端关闭后send不应使进程退出，而是作为连接错误计入结果
+    signal(SIGPIPE, SIG_IGN);
+    try
+    {
+        const mooon::net::ip_address_t ip(mooon::argument::ip->c_value());
+        if ("server" == mode)
+        {
+            run_server(ip);
+            return 0;
+        }
+
+        CEchoServer server;
+        if ("loopback" == mode)
+            server.start(ip, mooon::argument::port->value(), mooon::argument::loops->value(),
+                         mooon::argument::pin_cpu->is_true(), mooon::argument::budget->value());
+
+        config.peer = mooon::net::ip_node_t(mooon::argument::port->value(), ip);
+        config.connections = mooon::argument::connections->value();
+        config.threads = std::min(mooon::argument::threads->value(), config.connections);
+        config.message_size = mooon::argument::size->value();
+        config.depth = mooon::argument::depth->value();
+        config.verify = mooon::argument::verify->is_true();
+        config.use_pool = mooon::argument::pool->is_true();
+        config.connect_timeout_ms = mooon::argument::connect_timeout->value();
+        config.warmup_ms = mooon::argument::warmup->value();
+        config.duration_ms = mooon::argument::duration->value();
+        fprintf(stdout, "%s %s:%u, connections=%u threads=%u size=%u depth=%u pattern=%s\n",
+                mode.c_str(), ip.to_string().c_str(), config.peer.port, config.connections, config.threads,
+                config.message_size, config.depth, get_payload_pattern_name(config.pattern));
+
+        load_result_t result;
+        if (!run_load(config, &result, &errmsg))
+        {
+            fprintf(stderr, "%s\n", errmsg.c_str());
+            exit(1);
+        }
+        print_result(result);
+        if (!errmsg.empty())
+            fprintf(stderr, "%s\n", errmsg.c_str());
+        server.stop();
+
+        if (!mooon::argument::json->value().empty() && !write_json(mooon::argument::json->value(), config, result))
+        {
+            fprintf(stderr, "write %s failed: %s\n", mooon::argument::json->c_value(), strerror(errno));
+            exit(1);
+        }
+        return (0 == result.errors)? 0: 1;
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+    }
+    return 1;
+}
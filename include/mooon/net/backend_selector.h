@@ -0,0 +1,190 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_BACKEND_SELECTOR_H
+#define MOOON_NET_BACKEND_SELECTOR_H
+#include "mooon/net/config.h"
+#include "mooon/sys/clock.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/spin_lock.h"
+NET_NAMESPACE_BEGIN
+
+/** 后端的熔断状态 */
+typedef enum
+{
+    breaker_closed    = 0, /** 正常 */
+    breaker_open      = 1, /** 熔断中，不被选中 */
+    breaker_half_open = 2  /** 熔断到期，只放行少量探测请求 */
+}breaker_state_t;
+
+/** CBackendSelector的参数 */
+struct backend_policy_t
+{
+    uint32_t decay_milliseconds;        /** 延迟EWMA的衰减时间常数，越小越快反映最近的延迟 */
+    uint32_t failure_threshold;         /** 连续失败多少次后熔断 */
+    uint32_t open_milliseconds;         /** 第一次熔断的时长，探测失败再次熔断时加倍 */
+    uint32_t max_open_milliseconds;     /** 熔断的最长时长 */
+    uint32_t half_open_probes;          /** 半开时同时允许的探测请求数 */
+    uint32_t outlier_interval_milliseconds; /** 检查延迟异常的间隔，为0表示不剔除 */
+    double outlier_factor;              /** 延迟EWMA超过中位数的多少倍时被剔除 */
+    uint32_t outlier_min_nanoseconds;   /** 延迟EWMA低于它时不剔除，避免延迟都很小时误剔除 */
+    uint32_t ejection_milliseconds;     /** 剔除的时长 */
+    uint32_t max_ejection_percent;      /** 最多同时剔除的后端比例 */
+
+    backend_policy_t()
+        : decay_milliseconds(10000), failure_threshold(5),
+          open_milliseconds(1000), max_open_milliseconds(30000), half_open_probes(1),
+          outlier_interval_milliseconds(1000), outlier_factor(3.0), outlier_min_nanoseconds(1000000),
+          ejection_milliseconds(10000), max_ejection_percent(50)
+    {
+    }
+};
+
+/** 一个后端的状态，用于监控 */
+struct backend_stats_t
+{
+    breaker_state_t state;
+    bool ejected;
+    uint32_t outstanding;          /** 选中后还未report的请求数 */
+    uint32_t consecutive_failures;
+    uint64_t ewma_nanoseconds;     /** 延迟的EWMA */
+    uint64_t selected_number;      /** 被选中的总次数 */
+};
+
+/***
+  * 多个后端（如多个thrift网关）间的选择，按延迟和熔断状态避开慢的和坏的后端：
+  * 1) 每个后端维护峰值敏感的延迟EWMA：延迟升高时立即跟上，降低时按decay_milliseconds平滑，
+  *    一直没有新样本的后端EWMA随时间衰减，以便重新得到少量请求来更新
+  * 2) 选择时随机取两个可用的后端，取EWMA乘以（在途请求数+1）较小的（power of two choices），
+  *    比总选最优的更不容易让所有客户端同时涌向同一个后端
+  * 3) 连续失败failure_threshold次的后端熔断，到期后半开，只放行half_open_probes个探测请求，
+  *    探测成功则恢复，失败则以加倍的时长再次熔断
+  * 4) 定期剔除延迟EWMA远大于中位数的后端（不超过max_ejection_percent），到期后自动恢复
+  *
+  * 后端以下标表示，可用于任何按下标管理连接的池（如CThriftClientPool），
+  * 每个后端的状态独占缓存行，选择只读原子变量，不加锁，
+  * 只有report和熔断状态转换时加该后端自己的锁，没有全局锁，可被任意线程调用。
+  *
+  * 使用示例：
+  * int index = selector.select();
+  * const uint64_t start = mooon::sys::CClock::get_nanoseconds();
+  * bool ok = call(backends[index]);
+  * selector.report(index, ok, mooon::sys::CClock::get_nanoseconds() - start);
+  */
+class CBackendSelector
+{
+public:
+    CBackendSelector(uint32_t backend_number, const backend_policy_t& policy=backend_policy_t());
+    ~CBackendSelector();
+
+    /***
+      * 选择一个后端，计入其在途请求数，之后必须调用report或cancel
+      * @return: 后端下标，所有后端都熔断或被剔除时返回-1
+      */
+    int select();
+
+    /***
+      * 选择一个满足条件的后端，如连接数未满的
+      * @usable: 判断后端是否可用，返回false的不被选中
+      */
+    template <class Predicate>
+    int select(Predicate usable);
+
+    /***
+      * 报告请求的结果
+      * @success: 失败（如连接失败、超时或传输出错）计入熔断，应用层的错误应答应视为成功
+      * @latency_nanoseconds: 请求的耗时，失败时不计入EWMA
+      */
+    void report(uint32_t index, bool success, uint64_t latency_nanoseconds);
+
+    /** 选中后没有发出请求，只减少在途请求数 */
+    void cancel(uint32_t index);
+
+    uint32_t get_backend_number() const { return _backend_number; }
+    void get_stats(uint32_t index, backend_stats_t* stats) const;
+
+private:
+    struct Backend;
+
+    bool is_available(uint32_t index, uint64_t now);
+    double get_cost(const Backend& backend, uint64_t now) const;
+    int pick(uint32_t first, uint32_t second, uint64_t now);
+    bool finish_select(uint32_t index);
+    void check_outliers(uint64_t now);
+    static uint32_t get_random();
+
+private:
+    const uint32_t _backend_number;
+    const backend_policy_t _policy;
+    Backend* _backends;
+    uint64_t _next_outlier_check; /** 下一次检查延迟异常的时间 */
+};
+
+struct CBackendSelector::Backend
+{
+    sys::CAdaptiveLock lock;     /** 保护熔断状态的转换和EWMA的更新 */
+    uint32_t state;              /** breaker_state_t */
+    uint32_t outstanding;
+    uint32_t probes;             /** 半开时在途的探测请求数 */
+    uint32_t consecutive_failures;
+    uint32_t open_milliseconds;  /** 本次熔断的时长 */
+    uint64_t open_until;         /** 熔断到期的时间 */
+    uint64_t eject_until;        /** 剔除到期的时间 */
+    uint64_t ewma;               /** 延迟EWMA的纳秒数 */
+    uint64_t last_sample;        /** 最近一次更新EWMA的时间 */
+    uint64_t selected_number;
+} __attribute__((aligned(64)));
+
+template <class Predicate>
+int CBackendSelector::select(Predicate usable)
+{
+    const uint64_t now = sys::CClock::get_nanoseconds();
+
+    // 先随机取两次，都不可用时再遍历，后端大多可用时只需看两个
+    if (_backend_number > 1)
+    {
+        const uint32_t first = get_random() % _backend_number;
+        const uint32_t second = (first + 1 + get_random() % (_backend_number - 1)) % _backend_number;
+        const bool first_ok = usable(first) && is_available(first, now);
+        const bool second_ok = usable(second) && is_available(second, now);
+        if (first_ok || second_ok)
+        {
+            const int selected = pick(first_ok? first: second, second_ok? second: first, now);
+            if (selected != -1)
+                return selected;
+        }
+    }
+
+    int selected = -1;
+    const uint32_t start = get_random();
+    for (uint32_t i=0; i<_backend_number; ++i)
+    {
+        const uint32_t index = (start + i) % _backend_number;
+        if (!usable(index) || !is_available(index, now))
+            continue;
+        if ((-1 == selected) || (get_cost(_backends[index], now) < get_cost(_backends[selected], now)))
+            selected = static_cast<int>(index);
+    }
+
+    if ((selected != -1) && !finish_select(static_cast<uint32_t>(selected)))
+        selected = -1;
+    return selected;
+}
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_BACKEND_SELECTOR_H
@@ -0,0 +1,493 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_COROUTINE_H
+#define MOOON_NET_COROUTINE_H
+#include "mooon/net/event_loop.h"
+#include "mooon/net/ip_node.h"
+#if (__cplusplus >= 202002L) && __has_include(<coroutine>)
+#define MOOON_HAVE_COROUTINE 1
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 基于C++20协程的异步接口，运行在CEventLoop之上（需要-std=c++20，CMake.common在支持时会选用），
+  * 以顺序的写法代替回调和状态机，一个事件循环线程可同时运行成千上万个协程会话。
+  *
+  * 1) CTask<T>是惰性的协程，co_await时才开始执行，完成后恢复等待者，异常传给等待者
+  * 2) spawn将一个CTask<void>交给事件循环运行，不等待它完成
+  * 3) when_all并发运行一组CTask，全部完成后返回，有异常时在全部完成后抛出第一个异常
+  * 4) async_sleep和CAsyncSocket的connect/accept/receive/send是可co_await的异步操作，
+  *    能立即完成时不挂起，否则在事件循环中等待就绪或超时
+  *
+  * 协程只在所在事件循环的线程中运行，所以它们之间不需要加锁；
+  * 事件循环停止时仍挂起的协程不会被恢复，应在停止前让它们结束。
+  *
+  * 使用示例：
+  * CTask<void> echo(CEventLoop* event_loop, int fd)
+  * {
+  *     CAsyncSocket socket(event_loop, fd);
+  *     char buffer[1024];
+  *     for (;;)
+  *     {
+  *         const ssize_t bytes = co_await socket.receive(buffer, sizeof(buffer), 60000);
+  *         if (0 == bytes)
+  *             break;
+  *         co_await socket.full_send(buffer, bytes);
+  *     }
+  * }
+  * spawn(reactor_pool.next_loop(), echo(event_loop, fd));
+  */
+
+template <typename T> class CTask;
+
+/***
+  * CTask的promise的公共部分
+  */
+class CTaskPromiseBase
+{
+public:
+    /** 完成时转到等待者，没有等待者时挂起，由CTask析构时销毁 */
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> continuation = handle.promise().get_continuation();
+            return continuation? continuation: std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+public:
+    std::suspend_always initial_suspend() const noexcept { return std::suspend_always(); }
+    final_awaiter final_suspend() const noexcept { return final_awaiter(); }
+    void unhandled_exception() { _exception = std::current_exception(); }
+
+    void set_continuation(std::coroutine_handle<> continuation) { _continuation = continuation; }
+    std::coroutine_handle<> get_continuation() const { return _continuation; }
+
+protected:
+    void rethrow_if_exception() const
+    {
+        if (_exception)
+            std::rethrow_exception(_exception);
+    }
+
+private:
+    std::coroutine_handle<> _continuation;
+    std::exception_ptr _exception;
+};
+
+template <typename T>
+class CTaskPromise: public CTaskPromiseBase
+{
+public:
+    CTask<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value) { _value.emplace(std::forward<U>(value)); }
+
+    T get_result()
+    {
+        rethrow_if_exception();
+        return std::move(*_value);
+    }
+
+private:
+    std::optional<T> _value;
+};
+
+template <>
+class CTaskPromise<void>: public CTaskPromiseBase
+{
+public:
+    CTask<void> get_return_object();
+    void return_void() {}
+    void get_result() { rethrow_if_exception(); }
+};
+
+/***
+  * 协程任务，只能移动不能复制，析构时销毁协程
+  */
+template <typename T=void>
+class CTask
+{
+public:
+    typedef CTaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_t;
+
+    /** co_await一个CTask时启动它，并在它完成后恢复等待者 */
+    class CAwaiter
+    {
+    public:
+        explicit CAwaiter(handle_t handle): _handle(handle) {}
+        bool await_ready() const noexcept { return !_handle || _handle.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+        {
+            _handle.promise().set_continuation(continuation);
+            return _handle;
+        }
+
+        T await_resume() { return _handle.promise().get_result(); }
+
+    private:
+        handle_t _handle;
+    };
+
+public:
+    CTask() {}
+    explicit CTask(handle_t handle): _handle(handle) {}
+    CTask(CTask&& other) noexcept: _handle(other._handle) { other._handle = handle_t(); }
+
+    CTask& operator =(CTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_handle)
+                _handle.destroy();
+            _handle = other._handle;
+            other._handle = handle_t();
+        }
+        return *this;
+    }
+
+    ~CTask()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    bool is_valid() const { return static_cast<bool>(_handle); }
+    bool is_done() const { return _handle && _handle.done(); }
+    CAwaiter operator co_await() const noexcept { return CAwaiter(_handle); }
+
+    /***
+      * 不经co_await直接启动或继续运行直到第一次挂起，用于spawn和测试
+      */
+    void resume() const { _handle.resume(); }
+
+private:
+    CTask(const CTask&);
+    CTask& operator =(const CTask&);
+
+private:
+    handle_t _handle;
+};
+
+template <typename T>
+inline CTask<T> CTaskPromise<T>::get_return_object()
+{
+    return CTask<T>(CTask<T>::handle_t::from_promise(*this));
+}
+
+inline CTask<void> CTaskPromise<void>::get_return_object()
+{
+    return CTask<void>(CTask<void>::handle_t::from_promise(*this));
+}
+
+/***
+  * 将task交给事件循环运行，不等待它完成，task抛出的异常只被记录日志
+  * 可被任意线程调用，调用者即为循环线程时立即开始运行直到第一次挂起
+  */
+void spawn(CEventLoop* event_loop, CTask<void>&& task);
+
+/***
+  * 当前协程挂起milliseconds毫秒，只能在event_loop的线程中co_await
+  */
+class CSleepAwaiter: public ITimerHandler
+{
+public:
+    CSleepAwaiter(CEventLoop* event_loop, uint32_t milliseconds)
+        : _event_loop(event_loop), _milliseconds(milliseconds)
+    {
+    }
+
+    bool await_ready() const noexcept { return 0 == _milliseconds; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+
+private:
+    virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id);
+
+private:
+    CEventLoop* _event_loop;
+    uint32_t _milliseconds;
+    std::coroutine_handle<> _handle;
+};
+
+inline CSleepAwaiter async_sleep(CEventLoop* event_loop, uint32_t milliseconds)
+{
+    return CSleepAwaiter(event_loop, milliseconds);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// when_all
+
+/***
+  * when_all的计数，所有子任务和when_all本身各占一个，减到0时恢复when_all，
+  * 子任务都在同一事件循环线程中运行，所以不需要原子操作
+  */
+class CWhenAllLatch
+{
+public:
+    CWhenAllLatch(): _count(0) {}
+    std::coroutine_handle<> arrive() { return (0 == --_count)? _waiter: std::noop_coroutine(); }
+
+public:
+    size_t _count;
+    std::coroutine_handle<> _waiter;
+};
+
+/***
+  * 包装一个子任务，完成时到达latch
+  */
+class CWhenAllItem
+{
+public:
+    struct promise_type
+    {
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept { return handle.promise().latch->arrive(); }
+            void await_resume() const noexcept {}
+        };
+
+        CWhenAllLatch* latch;
+
+        CWhenAllItem get_return_object() { return CWhenAllItem(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return std::suspend_always(); }
+        final_awaiter final_suspend() const noexcept { return final_awaiter(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); } // 子任务的异常已在包装中捕获
+    };
+
+public:
+    explicit CWhenAllItem(std::coroutine_handle<promise_type> handle): _handle(handle) {}
+    CWhenAllItem(CWhenAllItem&& other) noexcept: _handle(other._handle) { other._handle = std::coroutine_handle<promise_type>(); }
+
+    ~CWhenAllItem()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    void start(CWhenAllLatch* latch)
+    {
+        _handle.promise().latch = latch;
+        _handle.resume();
+    }
+
+private:
+    CWhenAllItem(const CWhenAllItem&);
+    CWhenAllItem& operator =(const CWhenAllItem&);
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+/***
+  * 启动所有子任务，全部完成时恢复等待者，子任务都同步完成时不挂起
+  */
+class CWhenAllAwaiter
+{
+public:
+    explicit CWhenAllAwaiter(std::vector<CWhenAllItem>* items): _items(items) {}
+    bool await_ready() const noexcept { return _items->empty(); }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        _latch._count = _items->size() + 1;
+        _latch._waiter = handle;
+        for (std::vector<CWhenAllItem>::size_type i=0; i<_items->size(); ++i)
+            (*_items)[i].start(&_latch);
+        return --_latch._count > 0;
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    std::vector<CWhenAllItem>* _items;
+    CWhenAllLatch _latch;
+};
+
+template <typename T>
+CWhenAllItem make_when_all_item(CTask<T>& task, std::optional<T>* result, std::exception_ptr* exception)
+{
+    try
+    {
+        result->emplace(co_await task);
+    }
+    catch (...)
+    {
+        if (!*exception)
+            *exception = std::current_exception();
+    }
+}
+
+CWhenAllItem make_when_all_item(CTask<void>& task, std::exception_ptr* exception);
+
+/***
+  * 并发运行tasks，全部完成后按顺序返回各自的结果，
+  * 有子任务抛出异常时，仍等待其它子任务完成，然后抛出第一个异常
+  */
+template <typename T>
+CTask<std::vector<T> > when_all(std::vector<CTask<T> > tasks)
+{
+    std::vector<std::optional<T> > results(tasks.size());
+    std::exception_ptr exception;
+    std::vector<CWhenAllItem> items;
+
+    items.reserve(tasks.size());
+    for (typename std::vector<CTask<T> >::size_type i=0; i<tasks.size(); ++i)
+        items.push_back(make_when_all_item(tasks[i], &results[i], &exception));
+    co_await CWhenAllAwaiter(&items);
+    if (exception)
+        std::rethrow_exception(exception);
+
+    std::vector<T> values;
+    values.reserve(results.size());
+    for (typename std::vector<std::optional<T> >::size_type i=0; i<results.size(); ++i)
+        values.push_back(std::move(*results[i]));
+    co_return values;
+}
+
+CTask<void> when_all(std::vector<CTask<void> > tasks);
+
+////////////////////////////////////////////////////////////////////////////////
+// CAsyncSocket
+
+class CAsyncChannel;
+
+/***
+  * 协程中使用的非阻塞TCP套接字，通常作为协程的局部对象，只能在所属事件循环的线程中使用，
+  * 同一时刻最多一个协程在等待读（receive/accept）和一个协程在等待写（send/connect），
+  * 必须在所有等待结束后才能析构。
+  *
+  * milliseconds为等待就绪的超时毫秒数，0表示不超时；
+  * 出错或超时（错误码为ETIMEDOUT）时co_await抛出CSyscallException异常，
+  * 另一个协程调用close时，挂起中的等待以ECANCELED结束。
+  */
+class CAsyncSocket
+{
+    friend class CAsyncChannel;
+
+public:
+    typedef enum
+    {
+        io_receive = 0,
+        io_send    = 1,
+        io_accept  = 2,
+        io_connect = 3
+    }io_op_t;
+
+    /***
+      * 一次异步操作，先直接尝试，返回EAGAIN时才挂起，
+      * co_await的结果：receive和send为收发的字节数（receive为0表示对端已关闭），accept为新连接的fd，connect为0
+      */
+    class CIoAwaiter: public ITimerHandler
+    {
+        friend class CAsyncChannel;
+        friend class CAsyncSocket;
+
+    public:
+        CIoAwaiter(CAsyncSocket* socket, io_op_t op, void* buffer, size_t size, uint32_t milliseconds);
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        ssize_t await_resume();
+
+    private:
+        bool is_read() const { return (io_receive == _op) || (io_accept == _op); }
+        bool execute();
+        void complete(int errcode);
+        void cancel_timer();
+        void on_ready();
+        virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id);
+
+    private:
+        CAsyncSocket* _socket;
+        io_op_t _op;
+        void* _buffer;
+        size_t _size;
+        uint32_t _milliseconds;
+        uint64_t _timer_id;
+        bool _done;
+        int _errcode;
+        ssize_t _result;
+        std::coroutine_handle<> _handle;
+    };
+
+public:
+    /***
+      * @fd: 已有的套接字（如accept得到的），所有权转移给本对象，为-1时在connect时创建
+      * @exception: 出错抛出CSyscallException异常
+      */
+    CAsyncSocket(CEventLoop* event_loop, int fd=-1);
+    ~CAsyncSocket();
+
+    CEventLoop* get_event_loop() const { return _event_loop; }
+    int get_fd() const;
+
+    /** 关闭套接字，可重复调用 */
+    void close();
+
+    /***
+      * 连接到peer，fd为-1时创建套接字
+      * @exception: 出错抛出CSyscallException异常
+      */
+    CIoAwaiter connect(const ip_node_t& peer, uint32_t milliseconds=0);
+
+    /** 在监听套接字上接受一个连接，结果为新连接的fd */
+    CIoAwaiter accept(uint32_t milliseconds=0) { return CIoAwaiter(this, io_accept, NULL, 0, milliseconds); }
+
+    /** 接收到buffer，有数据即返回 */
+    CIoAwaiter receive(char* buffer, size_t buffer_size, uint32_t milliseconds=0) { return CIoAwaiter(this, io_receive, buffer, buffer_size, milliseconds); }
+
+    /** 发送buffer，可能只发送了一部分 */
+    CIoAwaiter send(const char* buffer, size_t buffer_size, uint32_t milliseconds=0) { return CIoAwaiter(this, io_send, const_cast<char*>(buffer), buffer_size, milliseconds); }
+
+    /***
+      * 收满buffer_size个字节，每次等待的超时为milliseconds
+      * @return: 如果对端在收满之前关闭则结果为false
+      */
+    CTask<bool> full_receive(char* buffer, size_t buffer_size, uint32_t milliseconds=0);
+
+    /** 发送完整个buffer，每次等待的超时为milliseconds */
+    CTask<void> full_send(const char* buffer, size_t buffer_size, uint32_t milliseconds=0);
+
+private:
+    CAsyncSocket(const CAsyncSocket&);
+    CAsyncSocket& operator =(const CAsyncSocket&);
+
+private:
+    CEventLoop* _event_loop;
+    CAsyncChannel* _channel;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_HAVE_COROUTINE
+#endif // MOOON_NET_COROUTINE_H
@@ -19,21 +19,110 @@
 #ifndef MOOON_NET_DATA_STREAM_H
 #define MOOON_NET_DATA_STREAM_H
 #include "mooon/net/utils.h"
+#include "mooon/sys/slab_mem_pool.h"
+#include "mooon/utils/compressor.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif // __cplusplus >= 201703L
 NET_NAMESPACE_BEGIN
 
+/***
+  * 数组的批量字节反转，按元素大小分派，
+  * 2、4、8字节的元素逐个以__builtin_bswap反转，循环可被编译器向量化（如SSSE3的pshufb）
+  */
+template <size_t Size>
+struct CBulkReverser
+{
+    static void reverse(const void* source, void* result, uint32_t count)
+    {
+        const char* src = static_cast<const char*>(source);
+        char* dst = static_cast<char*>(result);
+        for (uint32_t i=0; i<count; ++i)
+            CUtils::reverse_bytes(src+i*Size, dst+i*Size, Size);
+    }
+};
+
+template <>
+struct CBulkReverser<1>
+{
+    static void reverse(const void* source, void* result, uint32_t count)
+    {
+        memmove(result, source, count);
+    }
+};
+
+template <>
+struct CBulkReverser<2>
+{
+    static void reverse(const void* source, void* result, uint32_t count)
+    {
+        const char* src = static_cast<const char*>(source);
+        char* dst = static_cast<char*>(result);
+        for (uint32_t i=0; i<count; ++i)
+        {
+            uint16_t n;
+            memcpy(&n, src+i*2, 2);
+            n = __builtin_bswap16(n);
+            memcpy(dst+i*2, &n, 2);
+        }
+    }
+};
+
+template <>
+struct CBulkReverser<4>
+{
+    static void reverse(const void* source, void* result, uint32_t count)
+    {
+        const char* src = static_cast<const char*>(source);
+        char* dst = static_cast<char*>(result);
+        for (uint32_t i=0; i<count; ++i)
+        {
+            uint32_t n;
+            memcpy(&n, src+i*4, 4);
+            n = __builtin_bswap32(n);
+            memcpy(dst+i*4, &n, 4);
+        }
+    }
+};
+
+template <>
+struct CBulkReverser<8>
+{
+    static void reverse(const void* source, void* result, uint32_t count)
+    {
+        const char* src = static_cast<const char*>(source);
+        char* dst = static_cast<char*>(result);
+        for (uint32_t i=0; i<count; ++i)
+        {
+            uint64_t n;
+            memcpy(&n, src+i*8, 8);
+            n = __builtin_bswap64(n);
+            memcpy(dst+i*8, &n, 8);
+        }
+    }
+};
+
 /***
   * 从数据流中读取数据类
+  *
+  * 变长整数为LEB128编码（每字节低7位为数据，最高位为1表示后面还有字节，低位在前），
+  * 有符号数先经zigzag映射（0,-1,1,-2...映射为0,1,2,3...），使绝对值小的负数也只占少量字节，
+  * 字符串为变长整数的长度加内容
   */
 class CStreamReader
 {
 public:
     /***
       * 析构释放内存，
-      * 但如果调用了detach，则什么也不做
+      * 但如果调用了detach，或数据流空间不属于自己，则什么也不做
       */
     ~CStreamReader()
     {
-        delete []_buffer;
+        if (_own_buffer)
+            delete []_buffer;
     }
 
     /***
@@ -43,7 +132,9 @@ public:
       */
     CStreamReader(uint32_t size, bool reverse_bytes=false)
         :_size(size)
+        ,_offset(0)
         ,_reverse_bytes(reverse_bytes)
+        ,_own_buffer(true)
     {
         _buffer = new char[_size];
     }
@@ -57,10 +148,28 @@ public:
     CStreamReader(char* buffer, uint32_t size, bool reverse_bytes=false)
         :_buffer(buffer)
         ,_size(size)
+        ,_offset(0)
         ,_reverse_bytes(reverse_bytes)
+        ,_own_buffer(true)
     {        
     }
 
+    /***
+      * 构造一个数据流读取操作对象，直接读取调用者的数据，不复制
+      * @data: 被读取的数据，在读取期间（包括read_string返回的指针使用期间）须保持有效
+      * @size: 数据大小
+      * @reverse_bytes: 是否反转字节
+      * @own_buffer: 为true时data必须是new char[]出来的，析构时delete[]
+      */
+    CStreamReader(const char* data, uint32_t size, bool reverse_bytes, bool own_buffer)
+        :_buffer(const_cast<char*>(data))
+        ,_size(size)
+        ,_offset(0)
+        ,_reverse_bytes(reverse_bytes)
+        ,_own_buffer(own_buffer)
+    {
+    }
+
     /***
       * 得到指向数据流空间起始位置的指针
       */
@@ -85,6 +194,14 @@ public:
         return _offset;
     }
 
+    /***
+      * 得到还未读取的数据大小
+      */
+    uint32_t get_remaining() const
+    {
+        return _size - _offset;
+    }
+
     /***
       * 脱离数据流，并返回指向流空间起始位置的地址，
       * 调用后，数据流空间的内存需要调用者调用delete[]去释放
@@ -106,7 +223,8 @@ public:
     {
         if (_offset + sizeof(m) > _size) return false;
 
-        DataType n = *((DataType *)(_buffer + _offset));
+        DataType n;
+        memcpy(&n, _buffer + _offset, sizeof(n)); // 数据流中的位置不一定对齐
         _offset += sizeof(m);
 
         if (!_reverse_bytes)
@@ -132,16 +250,148 @@ public:
 
         return true;
     }
+
+    /***
+      * 批量读取count个DataType，需要反转字节时整体反转
+      * @return: 如果读取会越界则返回false，否则返回true
+      */
+    template <typename DataType>
+    bool read_array(DataType* values, uint32_t count)
+    {
+        if (static_cast<uint64_t>(count) * sizeof(DataType) > get_remaining()) return false;
+
+        if (!_reverse_bytes)
+            memcpy(values, _buffer+_offset, count*sizeof(DataType));
+        else
+            CBulkReverser<sizeof(DataType)>::reverse(_buffer+_offset, values, count);
+        _offset += count * sizeof(DataType);
+
+        return true;
+    }
+
+    /***
+      * 读取LEB128变长整数，不受reverse_bytes影响
+      * @return: 如果数据不完整、超过10字节或超出value的范围，则返回false，且不移动读位置
+      */
+    bool read_varint(uint64_t& value)
+    {
+        uint64_t result = 0;
+        for (uint32_t offset=_offset, shift=0; (offset<_size) && (shift<64); shift+=7)
+        {
+            const uint8_t byte = static_cast<uint8_t>(_buffer[offset++]);
+            result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (0 == (byte & 0x80))
+            {
+                value = result;
+                _offset = offset;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool read_varint(uint32_t& value)
+    {
+        const uint32_t offset = _offset;
+        uint64_t n;
+        if (!read_varint(n)) return false;
+        if (n > UINT32_MAX)
+        {
+            _offset = offset;
+            return false;
+        }
+
+        value = static_cast<uint32_t>(n);
+        return true;
+    }
+
+    /***
+      * 读取zigzag编码的有符号变长整数
+      */
+    bool read_zigzag(int64_t& value)
+    {
+        uint64_t n;
+        if (!read_varint(n)) return false;
+
+        value = static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+        return true;
+    }
+
+    bool read_zigzag(int32_t& value)
+    {
+        const uint32_t offset = _offset;
+        int64_t n;
+        if (!read_zigzag(n)) return false;
+        if ((n < INT32_MIN) || (n > INT32_MAX))
+        {
+            _offset = offset;
+            return false;
+        }
+
+        value = static_cast<int32_t>(n);
+        return true;
+    }
+
+    /***
+      * 读取以变长整数为长度前缀的字符串，不复制
+      * @data: 指向数据流中字符串的起始位置，不以'\0'结尾
+      * @size: 字符串的长度
+      * @return: 如果数据不完整则返回false，且不移动读位置
+      */
+    bool read_string(const char*& data, uint32_t& size)
+    {
+        const uint32_t offset = _offset;
+        uint32_t length;
+        if (!read_varint(length)) return false;
+        if (length > get_remaining())
+        {
+            _offset = offset;
+            return false;
+        }
+
+        data = _buffer + _offset;
+        size = length;
+        _offset += length;
+        return true;
+    }
+
+    bool read_string(std::string& str)
+    {
+        const char* data;
+        uint32_t size;
+        if (!read_string(data, size)) return false;
+
+        str.assign(data, size);
+        return true;
+    }
+
+#if __cplusplus >= 201703L
+    bool read_string(std::string_view& view)
+    {
+        const char* data;
+        uint32_t size;
+        if (!read_string(data, size)) return false;
+
+        view = std::string_view(data, size);
+        return true;
+    }
+#endif // __cplusplus >= 201703L
     
 private:
     char* _buffer;
     uint32_t _size;
     uint32_t _offset;
     bool _reverse_bytes; /** 是否反转字节 */
+    bool _own_buffer;    /** 析构时是否delete[]数据流空间 */
 };
 
 /***
   * 往数据流写数据类
+  *
+  * 以growable构造的可自动增长，空间不够时按两倍扩大，不需要事先计算大小，
+  * 指定了mem_pool时从内存池分配（mem_pool非线程安全，多线程时应每线程一个），
+  * 编码格式见CStreamReader
   */
 class CStreamWriter
 {
@@ -152,7 +402,7 @@ public:
       */
     ~CStreamWriter()
     {
-        delete []_buffer;
+        free_buffer(_buffer, _size);
     }
 
     /***
@@ -162,7 +412,10 @@ public:
       */
     CStreamWriter(uint32_t size, bool reverse_bytes=false)
         :_size(size)
+        ,_offset(0)
         ,_reverse_bytes(reverse_bytes)
+        ,_growable(false)
+        ,_mem_pool(NULL)
     {
         _buffer = new char[_size];
     }
@@ -176,10 +429,31 @@ public:
     CStreamWriter(char* buffer, uint32_t size, bool reverse_bytes=false)
         :_buffer(buffer)
         ,_size(size)
+        ,_offset(0)
         ,_reverse_bytes(reverse_bytes)
+        ,_growable(false)
+        ,_mem_pool(NULL)
     {        
     }
 
+    /***
+      * 构造可自动增长的数据流写对象
+      * @mem_pool: 流空间从中分配的内存池，为NULL时使用new char[]
+      * @initial_size: 初始的流空间大小
+      * @reverse_bytes: 是否反转字节
+      */
+    CStreamWriter(sys::CSlabMemPool* mem_pool, uint32_t initial_size, bool reverse_bytes=false)
+        :_size(initial_size)
+        ,_offset(0)
+        ,_reverse_bytes(reverse_bytes)
+        ,_growable(true)
+        ,_mem_pool(mem_pool)
+    {
+        _buffer = allocate_buffer(_size);
+        if (NULL == _buffer)
+            _size = 0;
+    }
+
     /***
       * 得到指向数据流空间起始位置的地址
       */
@@ -203,10 +477,19 @@ public:
     {
         return _offset;
     }
+
+    /***
+      * 清空已写入的数据，流空间保留，以便重复使用
+      */
+    void clear()
+    {
+        _offset = 0;
+    }
     
     /***
       * 脱离数据流，并返回指向流空间起始位置的地址，
-      * 调用后，流空间的内存需要调用者调用delete[]去释放
+      * 调用后，流空间的内存需要调用者调用delete[]去释放，
+      * 如果指定了mem_pool，则需以get_size()的大小归还给mem_pool
       */
     char* detach()
     {
@@ -215,6 +498,32 @@ public:
         return ptr;
     }
 
+    /***
+      * 确保还能写入size字节，可增长的才会扩大流空间
+      * @return: 如果空间不够且不能增长，则返回false
+      */
+    bool reserve(uint32_t size)
+    {
+        const uint64_t required = static_cast<uint64_t>(_offset) + size;
+        if (required <= _size) return true;
+        if (!_growable || (required > UINT32_MAX)) return false;
+
+        uint64_t new_size = (_size > 0)? static_cast<uint64_t>(_size) * 2: 64;
+        if (new_size < required)
+            new_size = required;
+        if (new_size > UINT32_MAX)
+            new_size = UINT32_MAX;
+
+        char* new_buffer = allocate_buffer(static_cast<uint32_t>(new_size));
+        if (NULL == new_buffer) return false;
+
+        memcpy(new_buffer, _buffer, _offset);
+        free_buffer(_buffer, _size);
+        _buffer = new_buffer;
+        _size = static_cast<uint32_t>(new_size);
+        return true;
+    }
+
     /***
       * 往数据流里写数据
       * @m: 需要写入数据流中的数据
@@ -223,7 +532,7 @@ public:
     template <typename DataType>
     bool write(const DataType& m)
     {
-        if (_offset + sizeof(m) > _size) return false;
+        if (!reserve(sizeof(m))) return false;
 
         DataType n;
         if (!_reverse_bytes)
@@ -231,7 +540,7 @@ public:
         else
             CUtils::reverse_bytes<DataType>(&m, &n);
         
-        memcpy(_buffer, &n, sizeof(m));
+        memcpy(_buffer+_offset, &n, sizeof(m));
         _offset += sizeof(m);
 
         return true;
@@ -244,19 +553,127 @@ public:
       */
     bool write(const char* buffer, uint32_t size)
     {
-        if (_offset + size > _size) return false;
+        if (!reserve(size)) return false;
         
-        memcpy(buffer, _buffer+_offset, size);
+        memcpy(_buffer+_offset, buffer, size);
         _offset += size;
 
         return true;
     }
+
+    /***
+      * 批量写入count个DataType，需要反转字节时整体反转
+      */
+    template <typename DataType>
+    bool write_array(const DataType* values, uint32_t count)
+    {
+        if ((static_cast<uint64_t>(count) * sizeof(DataType) > UINT32_MAX) || !reserve(count*sizeof(DataType))) return false;
+
+        if (!_reverse_bytes)
+            memcpy(_buffer+_offset, values, count*sizeof(DataType));
+        else
+            CBulkReverser<sizeof(DataType)>::reverse(values, _buffer+_offset, count);
+        _offset += count * sizeof(DataType);
+
+        return true;
+    }
+
+    /***
+      * 写入LEB128变长整数，不受reverse_bytes影响，最多占10字节
+      */
+    bool write_varint(uint64_t value)
+    {
+        if (!reserve(10) && !reserve(get_varint_size(value))) return false;
+
+        while (value >= 0x80)
+        {
+            _buffer[_offset++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        _buffer[_offset++] = static_cast<char>(value);
+
+        return true;
+    }
+
+    /***
+      * 写入zigzag编码的有符号变长整数，int32_t也可直接写入，
+      * 读取时可用read_zigzag(int32_t&)
+      */
+    bool write_zigzag(int64_t value)
+    {
+        return write_varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    /***
+      * 写入以变长整数为长度前缀的字符串
+      */
+    bool write_string(const char* data, uint32_t size)
+    {
+        const uint32_t offset = _offset;
+        if (!write_varint(size)) return false;
+        if (!write(data, size))
+        {
+            _offset = offset;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool write_string(const std::string& str)
+    {
+        if (str.size() > UINT32_MAX) return false;
+        return write_string(str.data(), static_cast<uint32_t>(str.size()));
+    }
+
+    /***
+      * 得到变长整数编码后的字节数
+      */
+    static uint32_t get_varint_size(uint64_t value)
+    {
+        uint32_t size = 1;
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            ++size;
+        }
+        return size;
+    }
+
+    /***
+      * 将已写入的数据压缩后追加到out，用于在发送或持久化前压缩整个数据流，
+      * 压缩器取自本线程，不需要每次创建上下文，
+      * 读取方以utils::decompress_data解压后再用CStreamReader读取
+      * @exception: 不支持的压缩方式或压缩出错时抛出utils::CException异常
+      */
+    void compress(utils::compression_t compression, std::string* out, int level=-1) const
+    {
+        utils::compress_data(compression, _buffer, _offset, out, level);
+    }
+
+private:
+    char* allocate_buffer(uint32_t size)
+    {
+        if (NULL == _mem_pool)
+            return new char[size];
+        return static_cast<char*>(_mem_pool->allocate(size));
+    }
+
+    void free_buffer(char* buffer, uint32_t size)
+    {
+        if (NULL == _mem_pool)
+            delete []buffer;
+        else if (buffer != NULL)
+            (void)_mem_pool->reclaim(buffer, size);
+    }
     
 private:
     char* _buffer;
     uint32_t _size;
     uint32_t _offset;
     bool _reverse_bytes; /** 是否反转字节 */
+    bool _growable;      /** 空间不够时是否自动增长 */
+    sys::CSlabMemPool* _mem_pool;
 };
 
 NET_NAMESPACE_END
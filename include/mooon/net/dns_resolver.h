@@ -0,0 +1,177 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_DNS_RESOLVER_H
+#define MOOON_NET_DNS_RESOLVER_H
+#include "mooon/net/ip_address.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/snapshot.h"
+#include "mooon/sys/thread_engine.h"
+#include <deque>
+#include <map>
+NET_NAMESPACE_BEGIN
+
+class CEventLoop;
+
+/***
+  * 异步解析的结果回调
+  */
+class IResolveHandler
+{
+public:
+    virtual ~IResolveHandler() {}
+
+    /***
+      * 解析完成时被调用，async_resolve指定了事件循环时在循环线程中调用，否则在解析线程中调用
+      * @ip_array: 解析得到的地址，已按happy eyeballs排序，失败时为空
+      * @errinfo: 失败时的错误信息
+      */
+    virtual void on_resolved(const std::string& hostname, const ip_address_array_t& ip_array, const std::string& errinfo) = 0;
+};
+
+/***
+  * 带缓存的DNS解析器，以解析线程池调用getaddrinfo，调用者不会因DNS故障而长时间阻塞：
+  * 1) 成功的结果缓存positive_ttl毫秒，失败的结果缓存negative_ttl毫秒，
+  *    getaddrinfo不返回TTL，所以TTL是配置的
+  * 2) 命中的结果在有效期的最后prefetch_ratio部分内被访问时，后台提前刷新，调用者仍立即得到缓存的结果
+  * 3) 过期后刷新失败或超时时，在stale_ttl毫秒内仍返回过期的成功结果（serve stale），避免重连卡住
+  * 4) 同一主机名同时只有一个解析在进行，其它请求等待它的结果
+  * 5) 结果按happy eyeballs（RFC 8305）排序，IPv6和IPv4交替，首选地址族在前
+  * 6) 可登记到sys::CSnapshotManager，重启后带着成功的解析结果启动，不必集中重新解析
+  *
+  * 是线程安全的。
+  */
+class CDnsResolver: public sys::ISnapshotable
+{
+public:
+    /***
+      * @positive_ttl: 成功结果的缓存毫秒数
+      * @negative_ttl: 失败结果的缓存毫秒数
+      * @stale_ttl: 过期后仍可使用的毫秒数，为0表示不使用过期的结果
+      * @prefetch_ratio: 在有效期的最后多少比例内访问时提前刷新，为0表示不提前刷新
+      * @prefer_ipv6: happy eyeballs排序时首选IPv6
+      */
+    CDnsResolver(uint32_t positive_ttl=60000, uint32_t negative_ttl=5000, uint32_t stale_ttl=300000, double prefetch_ratio=0.1, bool prefer_ipv6=false);
+    ~CDnsResolver();
+
+    /***
+      * 启动解析线程
+      * @thread_number: 解析线程个数
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(uint16_t thread_number=2);
+
+    /** 停止解析线程，未完成的异步请求以错误结束 */
+    void destroy();
+
+    /** 得到进程共享的解析器，第一次调用时以默认参数创建 */
+    static CDnsResolver* get_default();
+
+    /***
+      * 解析hostname，hostname已经是IP时直接返回，
+      * 缓存有效时立即返回，否则最多等待milliseconds毫秒
+      * @return: 成功返回true，否则errinfo为出错信息（超时为"timeout"）
+      */
+    bool resolve(const std::string& hostname, ip_address_array_t* ip_array, std::string* errinfo, uint32_t milliseconds=5000);
+
+    /***
+      * 异步解析，缓存有效时立即在调用者线程（指定了event_loop时在循环线程中）调用handler
+      * @event_loop: 在哪个事件循环中回调，为NULL时在解析线程或调用者线程中回调
+      */
+    void async_resolve(const std::string& hostname, IResolveHandler* handler, CEventLoop* event_loop=NULL);
+
+    /** 丢弃缓存，hostname为空时丢弃所有 */
+    void invalidate(const std::string& hostname=std::string());
+
+    /***
+      * 按happy eyeballs排序：首选地址族的第一个地址在前，之后两个地址族交替，
+      * 同一地址族内保持getaddrinfo（RFC 6724）的顺序
+      */
+    static void sort_happy_eyeballs(ip_address_array_t* ip_array, bool prefer_ipv6);
+
+    /** 调用getaddrinfo解析，会阻塞，结果未排序 */
+    static bool blocking_resolve(const std::string& hostname, ip_address_array_t* ip_array, std::string* errinfo);
+
+    /** 保存成功的解析结果及其剩余的有效期，失败的结果不保存 */
+    virtual void save_snapshot(sys::CSnapshotWriter* writer);
+
+    /** 恢复解析结果，有效期扣除快照保存后经过的时间，连stale_ttl也过了的不恢复 */
+    virtual bool load_snapshot(sys::CSnapshotReader* reader);
+
+public:
+    uint64_t get_hit_number() const { return __atomic_load_n(&_hit_number, __ATOMIC_RELAXED); }
+    uint64_t get_miss_number() const { return __atomic_load_n(&_miss_number, __ATOMIC_RELAXED); }
+    uint64_t get_prefetch_number() const { return __atomic_load_n(&_prefetch_number, __ATOMIC_RELAXED); }
+    uint64_t get_stale_number() const { return __atomic_load_n(&_stale_number, __ATOMIC_RELAXED); }
+    uint64_t get_lookup_number() const { return __atomic_load_n(&_lookup_number, __ATOMIC_RELAXED); }
+
+private:
+    struct Waiter
+    {
+        IResolveHandler* handler;
+        CEventLoop* event_loop;
+    };
+
+    struct Entry
+    {
+        Entry(): ok(false), resolving(false), resolved_time(0), expire_time(0), generation(0) {}
+
+        bool ok;
+        bool resolving;
+        uint64_t resolved_time;
+        uint64_t expire_time;  /** 为0表示还没有结果 */
+        uint64_t generation;   /** 每完成一次解析加一，同步等待者据此判断是否有了新结果 */
+        ip_address_array_t ip_array;
+        std::string errinfo;
+        std::vector<Waiter> waiters;
+    };
+
+    typedef std::map<std::string, Entry> entry_table_t;
+
+private:
+    void run();
+    void request(const std::string& hostname, Entry* entry);
+    bool use_cache(const std::string& hostname, Entry* entry, uint64_t now);
+    void deliver(const std::string& hostname, const Waiter& waiter, const ip_address_array_t& ip_array, const std::string& errinfo);
+
+private:
+    uint32_t _positive_ttl;
+    uint32_t _negative_ttl;
+    uint32_t _stale_ttl;
+    double _prefetch_ratio;
+    bool _prefer_ipv6;
+    volatile bool _stop;
+    std::vector<sys::CThreadEngine*> _threads;
+
+private:
+    sys::CLock _lock;
+    sys::CEvent _request_event;  /** 有新的解析请求 */
+    sys::CEvent _resolved_event; /** 有解析完成 */
+    std::deque<std::string> _requests;
+    entry_table_t _entry_table;
+
+private:
+    uint64_t _hit_number;
+    uint64_t _miss_number;
+    uint64_t _prefetch_number;
+    uint64_t _stale_number;
+    uint64_t _lookup_number;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_DNS_RESOLVER_H
@@ -43,7 +43,8 @@ typedef enum
     epoll_close           = 4,       /** 需要从Epoll中剔除，并关闭 */
     epoll_remove          = 5,       /** 需要从Epoll中剔除，但不关闭 */
     epoll_destroy         = 6,       /** 需要从Epoll中剔除，并且对象应当被销毁 */
-    epoll_release         = 7        /** 释放控制权 */
+    epoll_release         = 7,       /** 释放控制权 */
+    epoll_again           = 8        /** 本次的预算已用完但仍有数据，不修改事件，由CEventLoop在下一轮中再次调用，见CEventLoop::get_io_budget */
 }epoll_event_t;
 
 /***
@@ -132,6 +133,7 @@ long get_recv_buffer_bytes();
 class CEpollable: public sys::CRefCountable
 {
     friend class CEpoller;
+    friend class CEventLoop;
 
 public:
     CEpollable();
@@ -158,6 +160,13 @@ public:
     /** 得到设置的Epoll事件 */
     int get_epoll_events() const { return _epoll_events; }
 
+    /***
+      * 设置所属的租户，CEventLoop按租户的权重（见CEventLoop::set_tenant_weight）放大每次事件的预算，
+      * 默认为0号租户
+      */
+    void set_tenant(uint16_t tenant) { _tenant = tenant; }
+    uint16_t get_tenant() const { return _tenant; }
+
     /***
       * 判断指定fd是否为非阻塞的
       * @return: 如果fd为非阻塞的，则返回true，否则返回false
@@ -186,6 +195,30 @@ public:
       */
 	void set_nodelay(bool yes);
 
+    /***
+      * 设置套接字的忙轮询（SO_BUSY_POLL），阻塞的接收和Epoll上没有数据时先在网卡队列上轮询usecs微秒，
+      * 省去中断和唤醒的延迟，代价是轮询期间一直占用CPU，适合绑定在独占CPU上的低延迟连接
+      * @usecs: 忙轮询的微秒数，为0表示关闭，增大须有CAP_NET_ADMIN权限
+      * @prefer: 是否设置SO_PREFER_BUSY_POLL（Linux 5.11及以上），负载高时也优先忙轮询而不是中断
+      * @budget: 每次轮询最多处理的包数（SO_BUSY_POLL_BUDGET），为0表示不设置
+      * @return: 设置SO_BUSY_POLL失败（内核不支持或无权限）返回false，prefer和budget的失败不影响返回值，不抛出异常
+      */
+    bool set_busy_poll(uint32_t usecs, bool prefer=false, uint16_t budget=0);
+
+    /***
+      * 开启接收时间戳（SO_TIMESTAMPING），由recvmsg的控制信息得到报文到达的时间，
+      * 用来度量从网卡（或内核协议栈）到处理者的延迟，见CUdpMessageArena::get_timestamp
+      * @hardware: 是否要网卡的硬件时间戳，须网卡支持并已用SIOCSHWTSTAMP开启，否则只有软件时间戳
+      * @return: 内核不支持时返回false，不抛出异常
+      */
+    bool enable_timestamping(bool hardware=false);
+
+    /***
+      * 得到字符串格式的身份，用于日志（如CEventLoop的慢处理），
+      * 默认为“fd:句柄值”，子类（如CTcpClient）可重写为含对端地址的
+      */
+    virtual std::string to_string() const;
+
     /** 得到socket错误代码 */
     int get_socket_error_code();
 
@@ -226,6 +259,8 @@ private:
 private:
     int _fd;
     int _epoll_events;
+    uint16_t _tenant;
+    bool _again_queued; // 是否已在CEventLoop的再次调用队列中
 };
 
 NET_NAMESPACE_END
@@ -20,28 +20,55 @@
 #define MOOON_NET_EPOLLABLE_QUEUE_H
 #include "mooon/net/epollable.h"
 #include "mooon/sys/event.h"
+#include "mooon/sys/queue_delay.h"
+#include <sys/eventfd.h>
+#include <vector>
 NET_NAMESPACE_BEGIN
 
 /** 可以放入Epoll监控的队列
   * RawQueueClass为原始队列类名，如utils::CArrayQueue
   * 为线程安全类
+  *
+  * 支持两种通知方式：
+  * 1) 管道（默认）：每push一个元素write一次，每pop一个元素read一次
+  * 2) eventfd：只在队列由空变为非空时write一次，只在队列被取空时read一次，
+  *    一批push只产生一次通知，pop_front(elem_array, array_size)一次read即可取走整批，
+  *    每条消息的系统调用次数降为约每次Epoll唤醒一次
+  *
+  * 和sys::CEventQueue一样，可以记录元素的逗留时间并在过载时丢弃陈旧的元素或改为后进先出，见enable_delay_control
   */
 template <class RawQueueClass>
 class CEpollableQueue: public CEpollable
 {
     typedef typename RawQueueClass::_DataType DataType;
+    typedef std::vector<std::pair<DataType, uint64_t> > ShedElems;
     
 public:
     /** 构造一个可Epoll的队列，注意只可监控读事件，也就是队列中是否有数据
       * @queue_max: 队列最大可容纳的元素个数
+      * @use_eventfd: 是否使用eventfd替代管道作为通知方式
       * @exception: 如果出错，则抛出CSyscallException异常
       */
-    CEpollableQueue(uint32_t queue_max)
-        :_raw_queue(queue_max)
+    CEpollableQueue(uint32_t queue_max, bool use_eventfd=false)
+        :_use_eventfd(use_eventfd)
+        ,_raw_queue(queue_max)
         ,_push_waiter_number(0)
+        ,_delay_controller(NULL)
+        ,_shedder(NULL)
     {
-        if (-1 == pipe(_pipefd))
-            THROW_SYSCALL_EXCEPTION(NULL, errno, "pipe");
+        if (_use_eventfd)
+        {
+            // 读写使用同一个句柄，_pipefd[1]只是为了保持close等逻辑的一致
+            _pipefd[0] = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+            if (-1 == _pipefd[0])
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "eventfd");
+            _pipefd[1] = -1;
+        }
+        else
+        {
+            if (-1 == pipe(_pipefd))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "pipe");
+        }
 
         set_fd(_pipefd[0]);
     }
@@ -49,6 +76,23 @@ public:
     ~CEpollableQueue()
     {
         close();
+        delete _delay_controller;
+    }
+
+    /***
+      * 开启延迟控制，语义同sys::CEventQueue::enable_delay_control，须在使用队列之前调用
+      */
+    void enable_delay_control(const sys::CQueueDelayPolicy& policy, sys::IQueueShedder<DataType>* shedder=NULL)
+    {
+        delete _delay_controller;
+        _delay_controller = new sys::CQueueDelayController(policy, _raw_queue.capacity());
+        _shedder = shedder;
+    }
+
+    /** 得到逗留时间的直方图，未开启延迟控制时返回NULL */
+    sys::CLatencyHistogram* get_sojourn_histogram() const
+    {
+        return (NULL == _delay_controller)? NULL: _delay_controller->get_sojourn_histogram();
     }
 
     /** 关闭队列 */
@@ -106,8 +150,16 @@ public:
       */
     bool pop_front(DataType& elem) 
 	{
-        sys::LockHelper<sys::CLock> lock_helper(_lock);
-        return do_pop_front(elem);
+        bool popped;
+        ShedElems shed_elems;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            popped = do_pop_front(elem, &shed_elems);
+        }
+
+        notify_shedder(shed_elems);
+        return popped;
     }
 
     void pop_front()
@@ -125,15 +177,41 @@ public:
     void pop_front(DataType* elem_array, uint32_t& array_size)
     {
         uint32_t i = 0;
-        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        ShedElems shed_elems;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            if (_use_eventfd)
+            {
+                if (_delay_controller != NULL)
+                    shed_head(&shed_elems);
+                while ((i < array_size) && !_raw_queue.is_empty())
+                    elem_array[i++] = take_elem();
 
-        for (;;)
-        {            
-            if (!do_pop_front(elem_array[i])) break;
-            if (++i == array_size) break;
+                if (i > 0)
+                {
+                    if (_raw_queue.is_empty()) reset_eventfd();
+                    wakeup_push_waiters(i);
+                }
+            }
+            else
+            {
+                for (;;)
+                {
+                    if (!do_pop_front(elem_array[i], &shed_elems)) break;
+                    if (++i == array_size) break;
+                }
+            }
         }
 
         array_size = i;
+        notify_shedder(shed_elems);
+    }
+
+    /** 是否使用eventfd作为通知方式 */
+    bool use_eventfd() const
+    {
+        return _use_eventfd;
     }
     
 	/***
@@ -159,13 +237,25 @@ public:
             }
         }        
 
-        char c = 'x';
-        _raw_queue.push_back(elem);
-        // write还有相当于signal的作用
-        while (-1 == write(_pipefd[1], &c, sizeof(c)))
+        if (_delay_controller != NULL)
+            _delay_controller->on_push(sys::CClock::get_nanoseconds());
+        if (_use_eventfd)
         {
-            if (errno != EINTR)
-                THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
+            const bool was_empty = _raw_queue.is_empty();
+            _raw_queue.push_back(elem);
+            // 只有由空变为非空时才需要通知，同一批push只会产生一次write
+            if (was_empty) post_eventfd();
+        }
+        else
+        {
+            char c = 'x';
+            _raw_queue.push_back(elem);
+            // write还有相当于signal的作用
+            while (-1 == write(_pipefd[1], &c, sizeof(c)))
+            {
+                if (errno != EINTR)
+                    THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
+            }
         }
 
         return true;
@@ -179,11 +269,71 @@ public:
 	}
 
 private:
-    bool do_pop_front(DataType& elem)
+    bool do_pop_front(DataType& elem, ShedElems* shed_elems)
     {            
+        if (_delay_controller != NULL)
+            shed_head(shed_elems);
         // 没有数据，也不阻塞，如果需要阻塞，应当使用事件队列CEventQueue
         if (_raw_queue.is_empty()) return false;
 
+        if (_use_eventfd)
+        {
+            elem = take_elem();
+            if (_raw_queue.is_empty()) reset_eventfd();
+            wakeup_push_waiters(1);
+            return true;
+        }
+
+        read_pipe();
+        elem = take_elem();
+        // 如果有等待着，则唤醒其中一个
+        if (_push_waiter_number > 0) _event.signal();
+        
+        return true;
+    }
+
+    // 按延迟控制取队首或队尾的元素，调用前队列不能为空
+    DataType take_elem()
+    {
+        if (NULL == _delay_controller)
+            return _raw_queue.pop_front();
+
+        const uint64_t now_nanoseconds = sys::CClock::get_nanoseconds();
+        const bool lifo = _delay_controller->use_lifo(now_nanoseconds);
+        const DataType elem = lifo? _raw_queue.pop_back(): _raw_queue.pop_front();
+        (void)_delay_controller->on_pop(now_nanoseconds, lifo);
+        return elem;
+    }
+
+    // 丢弃队首逗留过久的元素，管道方式时每个元素对应的字节也要读走
+    void shed_head(ShedElems* shed_elems)
+    {
+        const typename ShedElems::size_type shed_number = shed_elems->size();
+        const uint64_t now_nanoseconds = sys::CClock::get_nanoseconds();
+
+        while ((_shedder != NULL) && _delay_controller->should_shed_head(now_nanoseconds))
+        {
+            if (!_use_eventfd)
+                read_pipe();
+
+            const DataType elem = _raw_queue.pop_front();
+            shed_elems->push_back(std::make_pair(elem, _delay_controller->on_shed_head(now_nanoseconds)));
+        }
+        if (shed_elems->size() > shed_number)
+        {
+            if (_use_eventfd && _raw_queue.is_empty()) reset_eventfd();
+            wakeup_push_waiters(static_cast<uint32_t>(shed_elems->size() - shed_number));
+        }
+    }
+
+    void notify_shedder(const ShedElems& shed_elems)
+    {
+        for (typename ShedElems::size_type i=0; i<shed_elems.size(); ++i)
+            _shedder->on_shed(shed_elems[i].first, shed_elems[i].second);
+    }
+
+    void read_pipe()
+    {
         char c;
         // read还有相当于CEvent::wait的作用
         while (-1 == read(_pipefd[0], &c, sizeof(c)))
@@ -191,20 +341,50 @@ private:
             if (errno != EINTR)
                 THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
         }
+    }
 
-        elem = _raw_queue.pop_front();
-        // 如果有等待着，则唤醒其中一个
-        if (_push_waiter_number > 0) _event.signal();
-        
-        return true;
+    void post_eventfd()
+    {
+        const eventfd_t value = 1;
+        while (-1 == eventfd_write(_pipefd[0], value))
+        {
+            if (errno != EINTR)
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "eventfd_write");
+        }
+    }
+
+    // 读操作将eventfd的计数清零，使其不再可读
+    void reset_eventfd()
+    {
+        eventfd_t value;
+        while (-1 == eventfd_read(_pipefd[0], &value))
+        {
+            if (EAGAIN == errno) break;
+            if (errno != EINTR)
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "eventfd_read");
+        }
+    }
+
+    void wakeup_push_waiters(uint32_t popped_number)
+    {
+        if (_push_waiter_number > 0)
+        {
+            if (popped_number > 1)
+                _event.broadcast();
+            else
+                _event.signal();
+        }
     }
 
 private:
-    int _pipefd[2]; /** 管道句柄 */
+    bool _use_eventfd; /** 是否使用eventfd */
+    int _pipefd[2]; /** 管道句柄，使用eventfd时_pipefd[0]为eventfd，_pipefd[1]为-1 */
     sys::CEvent _event;
     mutable sys::CLock _lock;    
     RawQueueClass _raw_queue; /** 普通队列实例 */
     volatile int32_t _push_waiter_number; /** 等待队列非满的线程个数 */
+    sys::CQueueDelayController* _delay_controller; /** 延迟控制，为NULL表示未开启 */
+    sys::IQueueShedder<DataType>* _shedder; /** 为NULL表示不丢弃 */
 };
 
 NET_NAMESPACE_END
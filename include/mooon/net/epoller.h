@@ -23,6 +23,34 @@
 #include "mooon/net/epollable.h"
 NET_NAMESPACE_BEGIN
 
+class CEpoller;
+
+/***
+  * dispatch中每个就绪对象的处理结果
+  */
+typedef struct
+{
+    CEpollable* epollable; /** 就绪的对象 */
+    uint32_t events;       /** 发生的Epoll事件 */
+    epoll_event_t result;  /** handle_epoll_event的返回值 */
+}epoll_result_t;
+
+/***
+  * 就绪集合的批量处理接口
+  */
+class IEpollDispatcher
+{
+public:
+    virtual ~IEpollDispatcher() {}
+
+    /***
+      * 一轮dispatch中所有handle_epoll_event调用完成后被调用一次
+      * @results: 所有就绪对象的处理结果，调用者可据此批量修改事件或剔除对象
+      * @n: results的元素个数
+      */
+    virtual void on_dispatched(CEpoller* epoller, const epoll_result_t* results, int n) = 0;
+};
+
 /***
   * Epoll操作封装类
   */
@@ -39,9 +67,13 @@ public:
     /***
       * 创建Epoll，进行初始化
       * @epoll_size: 建议性Epoll大小
+      * @trigger_flags: 附加到所有set_events上的标志，可为0、EPOLLET、EPOLLONESHOT或它们的组合，
+      *                 为EPOLLET时handle_epoll_event必须读或写到EAGAIN为止，
+      *                 为EPOLLONESHOT时每次事件处理完后需调用rearm重新激活，
+      *                 内部用于wakeup的感应器总是水平触发
       * @exception: 如果出错，抛出CSyscallException异常
       */
-    void create(uint32_t epoll_size);
+    void create(uint32_t epoll_size, uint32_t trigger_flags=0);
 
     /***
       * 销毁已经创建的Epoll
@@ -58,6 +90,33 @@ public:
       */
     int timed_wait(uint32_t milliseconds);
 
+    /***
+      * 等待并一次性处理整个就绪集合：对每个就绪对象调用handle_epoll_event，
+      * 结果收集到数组中，最后调用一次dispatcher->on_dispatched
+      * @milliseconds: 同timed_wait
+      * @dispatcher: 批量处理接口，可为NULL，这时可通过get_result取得结果
+      * @input_ptr: 传递给handle_epoll_event的input_ptr
+      * @return: 就绪对象个数，为0表示超时
+      * @exception: 如果出错，抛出CSyscallException异常，handle_epoll_event抛出的异常不会被捕获
+      */
+    int dispatch(uint32_t milliseconds, IEpollDispatcher* dispatcher, void* input_ptr=NULL);
+
+    /** 得到最近一次dispatch的第index个结果 */
+    const epoll_result_t& get_result(uint32_t index) const { return _results[index]; }
+
+    /** 得到附加的触发标志 */
+    uint32_t get_trigger_flags() const { return _trigger_flags; }
+
+    /***
+      * 设置Epoll的忙轮询参数（EPIOCSPARAMS，Linux 6.9及以上），epoll_wait没有事件时先在网卡队列上轮询，
+      * 而不是等中断唤醒，须配合套接字的CEpollable::set_busy_poll和网卡的NAPI配置
+      * @usecs: 每次epoll_wait最多忙轮询的微秒数，为0表示关闭
+      * @budget: 每次轮询最多处理的包数，为0表示取内核的默认值，超过默认值须有CAP_NET_ADMIN权限
+      * @prefer: 是否优先忙轮询（关闭网卡中断处理，须网卡设置了napi_defer_hard_irqs）
+      * @return: 内核不支持或无权限时返回false，不抛出异常
+      */
+    bool set_busy_poll(uint32_t usecs, uint16_t budget=0, bool prefer=true);
+
     /***
       * 将一个可Epoll的对象注册到Epoll监控中
       * @epollable: 指向可Epoll对象的指针
@@ -70,6 +129,12 @@ public:
       */
     void set_events(CEpollable* epollable, int events, bool force=false);
 
+    /***
+      * 以当前事件重新激活对象，用于EPOLLONESHOT模式
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void rearm(CEpollable* epollable);
+
     /***
       * 将一个可Epoll对象从Epoll中删除
       * @epollable: 指向可Epoll对象的指针
@@ -101,7 +166,9 @@ private:
     CSensor _sensor;
     uint32_t _epoll_size;
     uint32_t _max_events;
-    struct epoll_event* _events;     
+    uint32_t _trigger_flags;
+    struct epoll_event* _events;
+    epoll_result_t* _results;
 };
 
 NET_NAMESPACE_END
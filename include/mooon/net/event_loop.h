@@ -0,0 +1,388 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_EVENT_LOOP_H
+#define MOOON_NET_EVENT_LOOP_H
+#include "mooon/net/epoller.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/parker.h"
+#include "mooon/sys/task_scheduler.h"
+#include "mooon/sys/thread.h"
+#include "mooon/utils/bind.h"
+#include <map>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+class CEventLoop;
+class CWriteCoalescer;
+
+/***
+  * 投递到事件循环中执行的任务
+  */
+class ILoopTask
+{
+public:
+    virtual ~ILoopTask() {}
+
+    /***
+      * 在事件循环所在线程中被调用，调用返回后任务对象即被delete
+      * @event_loop: 执行任务的事件循环
+      */
+    virtual void execute(CEventLoop* event_loop) = 0;
+};
+
+/***
+  * 定时器回调接口
+  */
+class ITimerHandler
+{
+public:
+    virtual ~ITimerHandler() {}
+
+    /***
+      * 定时器到期时，在事件循环所在线程中被调用
+      * @timer_id: 定时器ID，即run_after的返回值
+      * @return: 返回下一次触发的间隔毫秒数，如果返回0则定时器不再触发
+      */
+    virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id) = 0;
+};
+
+/***
+  * 一次handle_epoll_event最多处理的量，为0表示不限制
+  */
+struct CIoBudget
+{
+    uint32_t bytes;    /** 最多读取的字节数 */
+    uint32_t messages; /** 最多处理的消息（如请求）个数 */
+
+    CIoBudget(uint32_t bytes_=0, uint32_t messages_=0)
+        : bytes(bytes_), messages(messages_)
+    {
+    }
+};
+
+/***
+  * 事件循环，一个线程一个CEpoller，
+  * 加入到循环的CEpollable对象归该循环所有，只能在该循环的线程中操作，
+  * 其它线程通过post投递任务到循环线程中执行，投递时使用CEpoller::wakeup唤醒循环。
+  *
+  * CEpollable::handle_epoll_event被调用时，input_ptr为所在的CEventLoop，返回值含义：
+  * epoll_none不做任何处理，epoll_read/epoll_write/epoll_read_write修改监控的事件，
+  * epoll_close剔除并关闭，epoll_remove和epoll_release剔除但不关闭，
+  * epoll_destroy剔除并关闭，剔除时都会调用dec_refcount，
+  * epoll_again不修改事件，在下一轮中（本轮其它就绪对象都处理之后）以同样的事件再次调用。
+  *
+  * 公平性：设置了预算（set_io_budget）时，handle_epoll_event应只读取get_io_budget的量，
+  * 用完而仍有数据时返回epoll_again，而不是读到EAGAIN为止，
+  * 这样一个持续可读的连接不会独占循环，同一循环上其它连接的等待时长有上界。
+  *
+  * 每个循环的度量，名字为reactor.loop<编号>.<名字>，同编号的循环计入同一个度量：
+  * iteration_ns为有事件、任务或定时器的一轮（含定时器、等待和处理）的耗时，空转的轮询不计入，
+  * events_per_wait为每次有事件的epoll_wait返回的事件数，
+  * busy_ns和wait_ns为处理（定时器、事件、任务和flush）和等待的累计纳秒数，两者之比即循环的繁忙度，
+  * timer_lag_ms为定时器实际触发比到期时间晚的毫秒数，pending_tasks为已投递到本循环还未执行的任务数，
+  * slow_handlers为超过set_slow_handler_threshold的handle_epoll_event次数。
+  * 循环线程被命名为reactor.loop<编号>，CThreadSampler可据此输出它的CPU使用率和调度等待。
+  */
+class CEventLoop: public sys::CThread
+{
+public:
+    /***
+      * 构造一个事件循环
+      * @index: 事件循环编号
+      * @epoll_size: 建议性Epoll大小
+      * @cpu: 绑定的CPU编号，如果为负数则不绑定
+      */
+    CEventLoop(uint16_t index=0, uint32_t epoll_size=10000, int cpu=-1);
+    ~CEventLoop();
+
+    /** 得到事件循环编号 */
+    uint16_t get_index() const { return _index; }
+
+    /** 得到绑定的CPU编号，为负数表示未绑定 */
+    int get_cpu() const { return _cpu; }
+
+    /** 判断调用者是否为事件循环所在线程 */
+    bool in_loop_thread() const;
+
+    /** 得到本循环拥有的CEpollable个数，可被任意线程调用，用于负载均衡 */
+    uint32_t get_epollable_number() const;
+
+    /***
+      * 将epollable加入本循环，引用计数会被增一，只能在循环线程中调用
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void add(CEpollable* epollable, int events);
+
+    /***
+      * 修改epollable监控的事件，只能在循环线程中调用
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void modify(CEpollable* epollable, int events);
+
+    /***
+      * 将epollable从本循环剔除，引用计数会被减一，只能在循环线程中调用
+      * @close_it: 剔除后是否关闭
+      */
+    void remove(CEpollable* epollable, bool close_it);
+
+    /***
+      * 投递任务，可被任意线程调用，任务对象的所有权转移给事件循环
+      * 如果调用者即为循环线程，也不会立即执行，而是在本轮事件处理之后执行
+      */
+    void post(ILoopTask* task);
+
+    /***
+      * 投递utils::bind的结果，语义同post(ILoopTask*)，
+      * 绑定的函数对象内联在Functor中，队列中的位置复用，所以通常不从堆上分配内存
+      */
+    void post(utils::Functor<void> functor);
+
+    /***
+      * 按调度属性投递，可被任意线程调用：不带调度属性的任务每轮全部执行，
+      * 带调度属性的在它们之后按通道的权重和截止时间（见sys::CTaskScheduler）每轮最多执行set_task_lanes指定的个数，
+      * 剩下的留到下一轮，使批量的任务不会长时间占住循环而拖慢I/O和交互的任务，
+      * 执行前已过截止时间的任务被丢弃（ILoopTask被delete），计入reactor.expired_tasks
+      */
+    void post(ILoopTask* task, const sys::CTaskPriority& priority);
+    void post(utils::Functor<void> functor, const sys::CTaskPriority& priority);
+
+    /***
+      * 设置带调度属性的任务的通道权重和每轮最多执行的个数，须在循环启动前调用，
+      * 默认只有一个通道，每轮最多执行64个
+      */
+    void set_task_lanes(const std::vector<uint32_t>& lane_weights, uint32_t tasks_per_round=64);
+
+    /***
+      * 从任意线程将epollable交给本循环，实际的add在循环线程中执行
+      */
+    void post_add(CEpollable* epollable, int events);
+
+    /***
+      * 批量交给本循环，只投递一个任务，在循环线程中一次加入全部，
+      * 用于监听线程一次accept到多个连接时减少唤醒次数
+      */
+    void post_add(CEpollable* const* epollables, uint32_t number, int events);
+
+    /***
+      * 增加一个定时器，只能在循环线程中调用
+      * @milliseconds: 多少毫秒后触发
+      * @handler: 定时器回调，所有权不转移
+      * @return: 定时器ID，可用于cancel_timer
+      */
+    uint64_t run_after(uint32_t milliseconds, ITimerHandler* handler);
+
+    /***
+      * 取消定时器，只能在循环线程中调用
+      * @return: 如果定时器存在则返回true，否则返回false
+      */
+    bool cancel_timer(uint64_t timer_id);
+
+    /***
+      * 在本轮事件和任务处理完之后调用coalescer的flush，只能在循环线程中调用，
+      * 由CWriteCoalescer::begin调用，见mooon/net/write_coalescer.h
+      */
+    void flush_later(CWriteCoalescer* coalescer);
+
+    /** 取消flush_later，只能在循环线程中调用 */
+    void cancel_flush(CWriteCoalescer* coalescer);
+
+    /***
+      * 设置空闲策略，须在循环启动前调用，默认为idle_block即阻塞的epoll_wait：
+      * 自旋的策略先以不等待的epoll_wait轮询strategy.spin_number轮，
+      * idle_spin_yield之后每轮再让出CPU，idle_spin_park再让出yield_number轮后才阻塞，idle_busy_spin一直轮询，
+      * 轮询期间post不会用CEpoller::wakeup唤醒（没有写eventfd的系统调用），投递的任务在下一轮即被执行
+      */
+    void set_idle_strategy(const sys::CIdleStrategy& idle_strategy) { _idle_strategy = idle_strategy; }
+
+    /***
+      * 低延迟的忙轮询模式，须在循环启动前调用：设置Epoll的忙轮询参数（见CEpoller::set_busy_poll），
+      * 并以idle_busy_spin一直用不等待的epoll_wait轮询，事件不再经由中断和唤醒送达，
+      * 应配合绑定独占的CPU（构造时的cpu参数，并以isolcpus等隔离）和套接字的CEpollable::set_busy_poll
+      * @return: 内核不支持Epoll的忙轮询参数时返回false，这时仍在用户态轮询
+      */
+    bool set_busy_poll(uint32_t usecs, uint16_t budget=0, bool prefer=true);
+
+    /***
+      * 设置每次handle_epoll_event的预算，须在循环启动前或在循环线程中调用，默认为0即不限制
+      * @bytes: 最多读取的字节数
+      * @messages: 最多处理的消息个数
+      */
+    void set_io_budget(uint32_t bytes, uint32_t messages);
+
+    /***
+      * 设置租户的权重，租户的对象每次的预算为set_io_budget的weight倍，须在循环启动前调用，
+      * 未设置的租户权重为1，weight为0时按1，调用时机同set_io_budget
+      */
+    void set_tenant_weight(uint16_t tenant, uint32_t weight);
+
+    /** 得到epollable本次事件的预算，为handle_epoll_event使用，为0的项表示不限制 */
+    CIoBudget get_io_budget(const CEpollable* epollable) const;
+
+    /***
+      * 设置慢处理的阈值，一次handle_epoll_event或定时器回调超过时以MYLOG_WARN（每秒最多10行）
+      * 输出CEpollable::to_string的身份和耗时，并计入reactor.loop<编号>.slow_handlers，
+      * 须在循环启动前或在循环线程中调用，默认为0即不检测（不对每次处理计时）
+      */
+    void set_slow_handler_threshold(uint32_t microseconds) { _slow_handler_nanoseconds = static_cast<uint64_t>(microseconds) * 1000; }
+
+    /** 得到当前的单调时钟毫秒数 */
+    static uint64_t get_monotonic_milliseconds();
+
+private:
+    virtual void run();
+    virtual void before_stop();
+
+private:
+    void handle_events(int n);
+    void handle_again();
+    epoll_event_t dispatch(CEpollable* epollable, uint32_t events);
+    void handle_result(CEpollable* epollable, uint32_t events, epoll_event_t result);
+    int wait_events(int milliseconds);
+    bool run_tasks();
+    int run_timers();
+    void release_removed();
+    void flush_coalescers();
+
+private:
+    typedef std::pair<uint64_t, uint64_t> timer_key_t; // 到期时间和定时器ID
+    typedef std::map<timer_key_t, ITimerHandler*> timer_table_t;
+    typedef std::map<uint64_t, uint64_t> timer_index_t; // 定时器ID到到期时间
+
+private:
+    uint16_t _index;
+    int _cpu;
+    pthread_t _loop_thread;
+    volatile uint32_t _epollable_number;
+    CEpoller _epoller;
+
+private:
+    sys::CLock _task_lock;
+    struct PostedTask
+    {
+        ILoopTask* task;             /** 为NULL时执行functor */
+        utils::Functor<void> functor;
+    };
+
+    void push_task(PostedTask* posted_task, const sys::CTaskPriority* priority=NULL);
+    void run_task(PostedTask* posted_task);
+
+    std::vector<PostedTask> _task_queue;
+    std::vector<PostedTask> _running_tasks;
+    sys::CTaskScheduler<PostedTask> _scheduled_tasks; // 带调度属性的任务，和_task_queue共用_task_lock
+    std::vector<PostedTask> _expired_tasks;
+    uint32_t _tasks_per_round;
+
+private:
+    sys::CIdleStrategy _idle_strategy;
+    uint32_t _idle_rounds; // 连续没有事件和任务的轮数
+    bool _polling;         // 是否正在轮询，轮询时post不需要唤醒
+
+private:
+    bool _dispatching;
+    std::vector<CEpollable*> _removed; // 本轮事件处理中被剔除，待处理完后再减引用计数
+
+private: // 预算
+    typedef std::pair<CEpollable*, uint32_t> again_t; // 对象和它的事件
+    CIoBudget _io_budget;
+    std::vector<uint32_t> _tenant_weights; // 下标为租户
+    std::vector<again_t> _again_queue;     // 返回epoll_again的对象，下一轮轮流再次调用，持有一个引用计数
+    std::vector<again_t> _running_again;
+
+private:
+    std::vector<CWriteCoalescer*> _flush_queue; // 本轮结束时需flush的写合并
+
+private: // 度量，见类的说明
+    sys::CLatencyHistogram* _iteration_histogram;
+    sys::CLatencyHistogram* _events_histogram;
+    sys::CLatencyHistogram* _timer_lag_histogram;
+    sys::CCounter* _busy_counter;
+    sys::CCounter* _wait_counter;
+    sys::CCounter* _slow_handlers_counter;
+    sys::CGauge* _pending_tasks_gauge;
+    uint64_t _slow_handler_nanoseconds;
+    uint32_t _work_number; // 本轮执行的定时器和任务数
+
+private:
+    uint64_t _next_timer_id;
+    timer_table_t _timer_table;
+    timer_index_t _timer_index;
+};
+
+/***
+  * 多个事件循环组成的Reactor池，
+  * 通常由accept所在的线程调用assign将新连接分配给其中一个循环
+  */
+class CReactorPool
+{
+public:
+    /** 新连接的分配策略 */
+    typedef enum
+    {
+        assign_round_robin  = 0, /** 轮询 */
+        assign_least_loaded = 1  /** 选择拥有CEpollable最少的循环 */
+    }assign_policy_t;
+
+public:
+    CReactorPool();
+    ~CReactorPool();
+
+    /***
+      * 创建并启动所有事件循环
+      * @loop_number: 事件循环个数，为0时取CPU个数
+      * @epoll_size: 每个循环的建议性Epoll大小
+      * @pin_cpu: 是否将第i个循环绑定到第i%CPU个数个CPU上
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void create(uint16_t loop_number, uint32_t epoll_size=10000, bool pin_cpu=true);
+
+    /** 停止并销毁所有事件循环 */
+    void destroy();
+
+    /** 设置分配策略 */
+    void set_assign_policy(assign_policy_t assign_policy) { _assign_policy = assign_policy; }
+
+    /** 得到事件循环个数 */
+    uint16_t get_loop_number() const { return static_cast<uint16_t>(_loop_array.size()); }
+
+    /** 根据编号得到事件循环 */
+    CEventLoop* get_loop(uint16_t index) const;
+
+    /** 按分配策略选择下一个事件循环，可被任意线程调用 */
+    CEventLoop* next_loop();
+
+    /***
+      * 按分配策略将epollable交给一个事件循环
+      * @return: 被选中的事件循环
+      */
+    CEventLoop* assign(CEpollable* epollable, int events);
+
+    /***
+      * 按分配策略批量分配，每个被选中的事件循环只投递一个任务
+      */
+    void assign(CEpollable* const* epollables, uint32_t number, int events);
+
+private:
+    assign_policy_t _assign_policy;
+    volatile uint32_t _next_loop;
+    std::vector<CEventLoop*> _loop_array;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_EVENT_LOOP_H
@@ -0,0 +1,386 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_FRAME_RECV_MACHINE_H
+#define MOOON_NET_FRAME_RECV_MACHINE_H
+#include <mooon/net/config.h>
+#include <mooon/sys/mem_pool.h>
+#include <algorithm>
+#include <deque>
+#include <string.h>
+#include <string>
+#include <sys/uio.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 成帧的批量接收状态机，和CRecvMachine的区别：
+  * 1) 数据以readv直接收到链式的接收块中，不需要先收到调用者的缓冲区再复制
+  * 2) 一次接收后，解码出所有完整的帧，每帧只回调一次，
+  *    帧在一个块内连续时直接给出块内的指针，跨块时才复制拼接
+  * 流水线式的小请求因此一次recv即可处理一批，而不是每个消息复制多次。
+  * receive处理完所有帧后归还接收块，空闲的连接不占用内存。
+  *
+  * @MessageHeaderType 消息头类型，要求是固定大小的，必须包含名为size的成员，为消息体字节数
+  * @ProcessorManager 必须包含如下方法：
+  *  bool on_header(const MessageHeaderType& header); // 解析出一个包头后被调用，返回false表示出错
+  *  bool on_frame(                                   // 收到一个完整的帧后被调用，返回false表示出错
+  *          const MessageHeaderType& header          // 包头
+  *        , const char* body                         // 消息体，只在回调期间有效，消息体为空时为NULL
+  *        , size_t body_size);                       // 消息体字节数，即header.size
+  */
+template <typename MessageHeaderType, class ProcessorManager>
+class CFrameRecvMachine
+{
+public:
+    /***
+      * @block_size: 接收块大小，大多数帧小于它时才能免复制，使用block_pool时取池的大小
+      * @block_pool: 接收块内存池，可由同一线程的多个连接共享，为NULL时从堆上分配
+      */
+    CFrameRecvMachine(ProcessorManager* processor_manager, size_t block_size=16384, sys::CRawMemPool* block_pool=NULL);
+    ~CFrameRecvMachine();
+
+    /***
+      * 从连接接收数据并解码，直到无数据可收，Connector需要有readv
+      * @return: 1) 如果出错，则返回utils::handle_error
+      *          2) 如果对端关闭了连接，则返回utils::handle_close
+      *          3) 如果还有未完整的帧，则返回utils::handle_continue
+      *          4) 如果刚好到帧的边界，则返回utils::handle_finish
+      * @exception: 网络错误时抛出CSyscallException异常
+      */
+    template <class Connector>
+    utils::handle_result_t receive(Connector* connector);
+
+    /***
+      * 解码由调用者收到的数据，数据会被复制到接收块中，返回值同receive
+      */
+    utils::handle_result_t work(const char* buffer, size_t buffer_size);
+
+    /** 复位状态，丢弃已缓冲的数据 */
+    void reset();
+
+    /** 得到已缓冲但还未成帧的字节数 */
+    size_t get_buffered_size() const { return _buffered_size; }
+
+    /** 得到已解码的帧数 */
+    uint64_t get_frame_number() const { return _frame_number; }
+
+    /** 得到因跨块而复制拼接的帧数 */
+    uint64_t get_copied_frame_number() const { return _copied_frame_number; }
+
+private:
+    struct Block
+    {
+        char* data;
+        size_t begin; /** 未解码数据的开始位置 */
+        size_t end;   /** 已收到数据的结束位置 */
+    };
+
+private:
+    char* allocate_block();
+    void reclaim_block(char* block);
+    void append(size_t bytes, char* spare_block);
+    utils::handle_result_t decode();
+    void copy_out(char* dest, size_t offset, size_t size) const;
+    void consume(size_t size);
+
+private:
+    ProcessorManager* _processor_manager;
+    sys::CRawMemPool* _block_pool;
+    size_t _block_size;
+    std::deque<Block> _blocks;
+    char* _spare_block;       /** 预先分配的下一个块，readv时作为第二个iovec */
+    size_t _buffered_size;
+    bool _header_checked;     /** 当前帧的包头是否已调用过on_header */
+    std::string _frame_buffer; /** 拼接跨块的帧 */
+    uint64_t _frame_number;
+    uint64_t _copied_frame_number;
+};
+
+template <typename MessageHeaderType, class ProcessorManager>
+CFrameRecvMachine<MessageHeaderType, ProcessorManager>::CFrameRecvMachine(
+    ProcessorManager* processor_manager, size_t block_size, sys::CRawMemPool* block_pool)
+ :_processor_manager(processor_manager)
+ ,_block_pool(block_pool)
+ ,_block_size((block_pool != NULL)? block_pool->get_bucket_size()-block_pool->get_guard_size(): block_size)
+ ,_spare_block(NULL)
+ ,_buffered_size(0)
+ ,_header_checked(false)
+ ,_frame_number(0)
+ ,_copied_frame_number(0)
+{
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+CFrameRecvMachine<MessageHeaderType, ProcessorManager>::~CFrameRecvMachine()
+{
+    reset();
+    if (_spare_block != NULL)
+        reclaim_block(_spare_block);
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+template <class Connector>
+utils::handle_result_t CFrameRecvMachine<MessageHeaderType, ProcessorManager>::receive(Connector* connector)
+{
+    for (;;)
+    {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        size_t space = 0;
+
+        // 先填满最后一个块，余下的收到备用块中
+        if (!_blocks.empty() && (_blocks.back().end < _block_size))
+        {
+            iov[iovcnt].iov_base = _blocks.back().data + _blocks.back().end;
+            iov[iovcnt].iov_len = _block_size - _blocks.back().end;
+            space += iov[iovcnt].iov_len;
+            ++iovcnt;
+        }
+        if (NULL == _spare_block)
+            _spare_block = allocate_block();
+        iov[iovcnt].iov_base = _spare_block;
+        iov[iovcnt].iov_len = _block_size;
+        space += _block_size;
+        ++iovcnt;
+
+        const ssize_t bytes = connector->readv(iov, iovcnt);
+        if (0 == bytes)
+            return utils::handle_close;
+        if (bytes < 0)
+            break; // 已无数据可收
+
+        append(static_cast<size_t>(bytes), _spare_block);
+        if (utils::handle_error == decode())
+            return utils::handle_error;
+
+        // 没有收满，说明内核中的数据已收完
+        if (static_cast<size_t>(bytes) < space)
+            break;
+    }
+
+    // 帧都已处理完时归还所有块，空闲的连接不占用接收块，下次可读时再分配，使用block_pool时代价很小
+    if (0 == _buffered_size)
+    {
+        reset();
+        if (_spare_block != NULL)
+        {
+            reclaim_block(_spare_block);
+            _spare_block = NULL;
+        }
+    }
+    return (0 == _buffered_size)
+          ? utils::handle_finish
+          : utils::handle_continue;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+utils::handle_result_t CFrameRecvMachine<MessageHeaderType, ProcessorManager>::work(const char* buffer, size_t buffer_size)
+{
+    while (buffer_size > 0)
+    {
+        size_t bytes;
+        if (!_blocks.empty() && (_blocks.back().end < _block_size))
+        {
+            Block& block = _blocks.back();
+            bytes = std::min(buffer_size, _block_size - block.end);
+            memcpy(block.data + block.end, buffer, bytes);
+            append(bytes, NULL);
+        }
+        else
+        {
+            if (NULL == _spare_block)
+                _spare_block = allocate_block();
+            bytes = std::min(buffer_size, _block_size);
+            memcpy(_spare_block, buffer, bytes);
+            append(bytes, _spare_block);
+        }
+
+        buffer += bytes;
+        buffer_size -= bytes;
+    }
+
+    if (utils::handle_error == decode())
+        return utils::handle_error;
+    return (0 == _buffered_size)
+          ? utils::handle_finish
+          : utils::handle_continue;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+void CFrameRecvMachine<MessageHeaderType, ProcessorManager>::reset()
+{
+    while (!_blocks.empty())
+    {
+        reclaim_block(_blocks.front().data);
+        _blocks.pop_front();
+    }
+
+    _buffered_size = 0;
+    _header_checked = false;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+char* CFrameRecvMachine<MessageHeaderType, ProcessorManager>::allocate_block()
+{
+    char* block = (_block_pool != NULL)? static_cast<char*>(_block_pool->allocate()): NULL;
+    return (block != NULL)? block: new char[_block_size];
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+void CFrameRecvMachine<MessageHeaderType, ProcessorManager>::reclaim_block(char* block)
+{
+    // 池不够时从堆上分配的块，池不认识，由这里释放
+    if ((NULL == _block_pool) || !_block_pool->reclaim(block))
+        delete []block;
+}
+
+// 收到了bytes个字节，先填在最后一个块的空闲部分，余下的在spare_block中
+template <typename MessageHeaderType, class ProcessorManager>
+void CFrameRecvMachine<MessageHeaderType, ProcessorManager>::append(size_t bytes, char* spare_block)
+{
+    _buffered_size += bytes;
+    if (!_blocks.empty() && (_blocks.back().end < _block_size))
+    {
+        Block& block = _blocks.back();
+        const size_t tail_bytes = std::min(bytes, _block_size - block.end);
+        block.end += tail_bytes;
+        bytes -= tail_bytes;
+    }
+
+    if (bytes > 0)
+    {
+        Block block;
+        block.data = spare_block;
+        block.begin = 0;
+        block.end = bytes;
+        _blocks.push_back(block);
+        _spare_block = NULL;
+    }
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+utils::handle_result_t CFrameRecvMachine<MessageHeaderType, ProcessorManager>::decode()
+{
+    while (_buffered_size >= sizeof(MessageHeaderType))
+    {
+        MessageHeaderType header;
+        copy_out(reinterpret_cast<char*>(&header), 0, sizeof(header));
+        if (!_header_checked)
+        {
+            if (!_processor_manager->on_header(header))
+            {
+                reset();
+                return utils::handle_error;
+            }
+
+            _header_checked = true;
+        }
+
+        const size_t body_size = static_cast<size_t>(header.size);
+        const size_t frame_size = sizeof(MessageHeaderType) + body_size;
+        if (_buffered_size < frame_size)
+            break; // 帧还不完整
+
+        // 帧在第一个块内连续时直接给出视图，否则复制拼接
+        const char* body = NULL;
+        const Block& first = _blocks.front();
+        if (0 == body_size)
+        {
+            body = NULL;
+        }
+        else if (first.end - first.begin >= frame_size)
+        {
+            body = first.data + first.begin + sizeof(MessageHeaderType);
+        }
+        else
+        {
+            _frame_buffer.resize(body_size);
+            copy_out(&_frame_buffer[0], sizeof(MessageHeaderType), body_size);
+            body = _frame_buffer.data();
+            ++_copied_frame_number;
+        }
+
+        const bool processed = _processor_manager->on_frame(header, body, body_size);
+        consume(frame_size);
+        _header_checked = false;
+        ++_frame_number;
+        if (!processed)
+        {
+            reset();
+            return utils::handle_error;
+        }
+    }
+
+    return utils::handle_continue;
+}
+
+// 从未解码数据的offset处复制size个字节
+template <typename MessageHeaderType, class ProcessorManager>
+void CFrameRecvMachine<MessageHeaderType, ProcessorManager>::copy_out(char* dest, size_t offset, size_t size) const
+{
+    for (typename std::deque<Block>::size_type i=0; size > 0; ++i)
+    {
+        const Block& block = _blocks[i];
+        const size_t block_bytes = block.end - block.begin;
+        if (offset >= block_bytes)
+        {
+            offset -= block_bytes;
+            continue;
+        }
+
+        const size_t bytes = std::min(size, block_bytes - offset);
+        memcpy(dest, block.data + block.begin + offset, bytes);
+        dest += bytes;
+        size -= bytes;
+        offset = 0;
+    }
+}
+
+// 丢弃已解码的size个字节，用完的块被回收，保留一个作为备用块
+template <typename MessageHeaderType, class ProcessorManager>
+void CFrameRecvMachine<MessageHeaderType, ProcessorManager>::consume(size_t size)
+{
+    _buffered_size -= size;
+    while (size > 0)
+    {
+        Block& block = _blocks.front();
+        const size_t bytes = std::min(size, block.end - block.begin);
+        block.begin += bytes;
+        size -= bytes;
+
+        // 最后一个块还有空闲空间时继续用于接收
+        if ((block.begin == block.end) && ((_blocks.size() > 1) || (block.end == _block_size)))
+        {
+            if (NULL == _spare_block)
+                _spare_block = block.data;
+            else
+                reclaim_block(block.data);
+            _blocks.pop_front();
+        }
+    }
+
+    // 全部解码完时从块头开始接收，使下一批帧尽量连续
+    if ((0 == _buffered_size) && (1 == _blocks.size()))
+    {
+        _blocks.front().begin = 0;
+        _blocks.front().end = 0;
+    }
+}
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_FRAME_RECV_MACHINE_H
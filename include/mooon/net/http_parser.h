@@ -0,0 +1,139 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_HTTP_PARSER_H
+#define MOOON_NET_HTTP_PARSER_H
+#include "mooon/net/config.h"
+#include <string_view>
+#include <sys/types.h>
+NET_NAMESPACE_BEGIN
+
+// 一个请求最多的头部个数，超过时应答431
+#define HTTP_HEADER_MAX 64
+
+/***
+  * 解析出的HTTP请求，各字段直接指向接收缓冲区，不复制，
+  * 只在处理该请求期间有效
+  */
+class CHttpRequest
+{
+public:
+    CHttpRequest();
+
+    /** 方法，如GET */
+    std::string_view get_method() const { return _method; }
+
+    /** 请求行中的完整目标，如/search?q=1 */
+    std::string_view get_target() const { return _target; }
+
+    /** 目标中?之前的部分 */
+    std::string_view get_path() const { return _path; }
+
+    /** 目标中?之后的部分，没有时为空 */
+    std::string_view get_query() const { return _query; }
+
+    /** HTTP/1.x中的x */
+    int get_minor_version() const { return _minor_version; }
+
+    /** 得到头部的值，名字不区分大小写，不存在时返回空 */
+    std::string_view get_header(std::string_view name) const;
+
+    int get_header_number() const { return _header_number; }
+    std::string_view get_header_name(int index) const { return _headers[index].name; }
+    std::string_view get_header_value(int index) const { return _headers[index].value; }
+
+    /** 消息体，分块编码的已被解码 */
+    std::string_view get_body() const { return _body; }
+
+    /** 应答后是否保持连接，HTTP/1.1默认保持，HTTP/1.0需有Connection: keep-alive */
+    bool is_keep_alive() const { return _keep_alive; }
+
+    /** 消息体是否为分块编码的 */
+    bool is_chunked() const { return _chunked; }
+
+private:
+    friend class CHttpRequestParser;
+    struct Header
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+private:
+    std::string_view _method;
+    std::string_view _target;
+    std::string_view _path;
+    std::string_view _query;
+    std::string_view _body;
+    int _minor_version;
+    bool _keep_alive;
+    bool _chunked;
+    int _header_number;
+    Header _headers[HTTP_HEADER_MAX];
+};
+
+/***
+  * 增量的HTTP/1.x请求解析器，每个连接一个
+  *
+  * 调用者将收到的数据放在同一个缓冲区中，每次从请求的开始处调用parse：
+  * 头部不完整时记住已扫描的位置，下一次只扫描新到的数据；
+  * 一个请求解析完后，调用者跳过其占用的字节，继续解析下一个（流水线）。
+  * 头部同时有Content-Length和Transfer-Encoding时视为错误，以防请求走私。
+  */
+class CHttpRequestParser
+{
+public:
+    /***
+      * @header_size_max: 请求行和头部的最大字节数，超过时应答431
+      * @body_size_max: 消息体的最大字节数，超过时应答413
+      */
+    CHttpRequestParser(size_t header_size_max=8192, size_t body_size_max=1048576);
+
+    void set_limits(size_t header_size_max, size_t body_size_max);
+
+    /***
+      * 解析buffer开头的一个请求
+      * @buffer: 已收到的数据，分块编码的消息体在其中就地解码
+      * @return: 1) 大于0为完整请求占用的字节数，request有效
+      *          2) 0表示请求还不完整，收到更多数据后以同一请求的开头再调用
+      *          3) -1表示请求有误，由get_error_status得到应答的状态码
+      */
+    ssize_t parse(char* buffer, size_t size, CHttpRequest* request);
+
+    /** 复位状态，切换到下一个请求时parse会自动调用 */
+    void reset();
+
+    /** 得到出错时应答的状态码，如400、413、431、501和505 */
+    int get_error_status() const { return _error_status; }
+
+private:
+    bool parse_header(char* buffer, CHttpRequest* request);
+    ssize_t decode_chunked(char* body, size_t size, size_t* body_size);
+    ssize_t fail(int status);
+
+private:
+    size_t _header_size_max;
+    size_t _body_size_max;
+    size_t _scanned;       /** 已扫描未找到头部结束的字节数 */
+    size_t _header_size;   /** 头部的字节数，为0表示头部还不完整 */
+    size_t _content_length;
+    int _error_status;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_HTTP_PARSER_H
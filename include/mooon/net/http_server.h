@@ -0,0 +1,199 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_HTTP_SERVER_H
+#define MOOON_NET_HTTP_SERVER_H
+#include "mooon/net/event_loop.h"
+#include "mooon/net/http_parser.h"
+#include "mooon/net/listen_manager.h"
+#include "mooon/net/listener.h"
+#include "mooon/sys/metrics.h"
+#include <map>
+#include <string>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+class CHttpConnection;
+class CHttpListener;
+
+/***
+  * HTTP应答，由处理器填写，处理器返回后由连接序列化发送，
+  * 不需要设置Content-Length、Connection和Date，它们由连接自动加上
+  */
+class CHttpResponse
+{
+public:
+    CHttpResponse();
+
+    /***
+      * 设置状态码，默认为200
+      * @reason_phrase: 为NULL时使用标准的，必须一直有效（通常为字符串常量）
+      */
+    void set_status(int status_code, const char* reason_phrase=NULL);
+    int get_status() const { return _status_code; }
+
+    /** 增加一个头部，不检查是否重复 */
+    void add_header(std::string_view name, std::string_view value);
+    void set_content_type(std::string_view content_type) { add_header("Content-Type", content_type); }
+
+    /** 应答后关闭连接 */
+    void set_close() { _close = true; }
+
+    /** 追加消息体 */
+    void append(std::string_view data);
+
+    /***
+      * 以分块编码（Transfer-Encoding: chunked）应答，之后每次write_chunk为一块，
+      * 头部在调用时即被写入发送缓冲区，之后不能再add_header，
+      * 缓冲的数据较多时会尝试发送，处理器返回时自动写结束块，
+      * 用于事先不知道长度的大应答，之前append的数据作为第一块
+      */
+    void begin_chunked();
+    void write_chunk(std::string_view data);
+
+    /** 得到状态码的标准描述，如200为OK */
+    static const char* get_reason_phrase(int status_code);
+
+private:
+    friend class CHttpConnection;
+    friend class CHttpServer;
+    void reset(CHttpConnection* connection, int minor_version, bool keep_alive, bool is_head);
+    void serialize_header(std::string* output, const std::string_view* content_length);
+    void finish();
+
+private:
+    CHttpConnection* _connection;
+    int _status_code;
+    const char* _reason_phrase;
+    int _minor_version;
+    bool _keep_alive;
+    bool _is_head;
+    bool _close;
+    bool _chunked;
+    std::string _headers;
+    std::string _body;
+};
+
+/***
+  * 路由的处理器，在连接所在的事件循环线程中被调用，不能阻塞，
+  * 同一处理器会被多个事件循环线程并发调用
+  */
+class IHttpHandler
+{
+public:
+    virtual ~IHttpHandler() {}
+    virtual void handle(const CHttpRequest& request, CHttpResponse* response) = 0;
+};
+
+/***
+  * 基于多Reactor的嵌入式HTTP/1.1服务端，用于管理、健康检查和度量等内部接口
+  *
+  * 每个事件循环拥有一个SO_REUSEPORT监听分片（由CListenManager创建），
+  * 在本循环内accept并处理其连接，连接不跨线程；
+  * 支持keep-alive、流水线（一次收到的多个请求依次处理，应答按序合并发送）和分块编码的应答，
+  * 请求以CHttpRequestParser就地解析，不复制。
+  *
+  * 每个路由有度量http.route.<路径>.requests和http.route.<路径>.latency_ns（处理器的耗时），
+  * 另有http.requests、http.bad_requests、http.not_found和http.connections。
+  */
+class CHttpServer
+{
+public:
+    CHttpServer();
+    ~CHttpServer();
+
+    /***
+      * 增加路由，应在start之前调用，处理器的所有权不转移
+      * @method: 如GET，为空时匹配所有方法，HEAD匹配GET的路由
+      * @path: 精确匹配的路径，以*结尾时为前缀匹配，多个前缀都匹配时取最长的
+      */
+    void add_route(const std::string& method, const std::string& path, IHttpHandler* handler);
+
+    /** 连接空闲（未收到请求）这么多毫秒后被关闭，默认60000，为0表示不关闭 */
+    void set_idle_timeout(uint32_t milliseconds) { _idle_milliseconds = milliseconds; }
+
+    /** 设置请求头部和消息体的最大字节数，同CHttpRequestParser */
+    void set_limits(size_t header_size_max, size_t body_size_max);
+
+    /***
+      * 设置每个连接每次可读事件最多读取的字节数和处理的请求数，应在start之前调用，
+      * 超出的留到事件循环的下一轮，使持续发送的连接不会拖慢同一循环上的其它连接，见CEventLoop::set_io_budget，
+      * 默认为0即不限制
+      */
+    void set_io_budget(uint32_t bytes, uint32_t messages) { _io_budget = CIoBudget(bytes, messages); }
+
+    /***
+      * 启动，创建事件循环和监听分片
+      * @port: 为0时由系统分配，由get_port得到
+      * @reactor_number: 事件循环个数，为0时取CPU个数
+      * @pin_cpu: 是否将事件循环绑定到CPU
+      * @exception: 出错抛出CSyscallException或CException异常
+      */
+    void start(const ip_address_t& ip, uint16_t port, uint16_t reactor_number=0, bool pin_cpu=false);
+
+    /** 停止服务，关闭所有连接 */
+    void stop();
+
+    /** 得到监听的端口 */
+    uint16_t get_port() const { return _port; }
+
+    /** 得到已处理的请求数 */
+    uint64_t get_request_number() const { return __atomic_load_n(&_request_number, __ATOMIC_RELAXED); }
+
+public: // 仅供内部的监听者和连接使用
+    /** 路由，由add_route创建 */
+    struct Route
+    {
+        std::string method;
+        std::string path;
+        IHttpHandler* handler;
+        sys::CCounter* requests;
+        sys::CLatencyHistogram* latency;
+    };
+
+    /** 每个事件循环的状态，只在该循环线程中访问 */
+    struct LoopContext;
+
+    void dispatch(const CHttpRequest& request, CHttpResponse* response);
+    size_t get_header_size_max() const { return _header_size_max; }
+    size_t get_body_size_max() const { return _body_size_max; }
+    uint32_t get_idle_timeout() const { return _idle_milliseconds; }
+    const CIoBudget& get_io_budget() const { return _io_budget; }
+    void on_bad_request() const;
+
+private:
+    const Route* find_route(std::string_view method, std::string_view path, bool* method_mismatch) const;
+
+private:
+    std::map<std::string, std::vector<Route>, std::less<> > _exact_routes;
+    std::vector<Route> _prefix_routes; // 按前缀从长到短
+    uint32_t _idle_milliseconds;
+    CIoBudget _io_budget;
+    size_t _header_size_max;
+    size_t _body_size_max;
+    uint16_t _port;
+    uint64_t _request_number;
+
+private:
+    CReactorPool _reactor_pool;
+    CListenManager<CHttpListener>* _listen_manager;
+    std::vector<LoopContext*> _loop_contexts;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_HTTP_SERVER_H
@@ -0,0 +1,197 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_IO_BUFFER_H
+#define MOOON_NET_IO_BUFFER_H
+#include "mooon/net/config.h"
+#include "mooon/sys/mem_pool.h"
+#include <deque>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/uio.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 外部内存的释放回调，和send_machine.h中的send_release_t相同
+  */
+typedef void (*io_release_t)(const char* data, size_t size, void* context);
+
+/***
+  * 链式的零拷贝I/O缓冲区，数据存放在一串引用计数的块中，每个片段引用某个块的一段，
+  * 1) slice/split/append(CIoBuffer*)只增减块的引用计数，不复制数据
+  * 2) prepend优先写入首块之前的空闲空间，用于在消息体之前加消息头
+  * 3) read_from以readv直接收到块中，write_to以writev直接从各片段发送
+  * 4) 块可从CRawMemPool分配，池不够或未指定时从堆上分配
+  * 5) 可引用外部内存（append_external），最后一个引用释放时调用释放回调
+  *
+  * 非线程安全，但块的引用计数是原子的，
+  * 同一块的不同片段可以在不同线程中只读使用（如一个线程收，另一个线程发），
+  * 只有独占（引用计数为1）的块才会被写入，
+  * 因为CRawMemPool非线程安全，片段跨线程释放时不要使用块池
+  *
+  * 使用示例（代理，收到的数据加上消息头后直接转发，不复制消息体）：
+  * CIoBuffer in, out;
+  * in.read_from(&upstream);
+  * in.split(body_size, &out);
+  * out.prepend(&header, sizeof(header));
+  * send_machine.push(&out);
+  */
+class CIoBuffer
+{
+public:
+    /***
+      * @block_size: 块大小，使用block_pool时取池的大小（减去块头和警戒字节）
+      * @block_pool: 块内存池，池的块大小（含警戒字节）须为8的倍数且大于块头，否则不使用，为NULL时从堆上分配
+      */
+    CIoBuffer(size_t block_size=16384, sys::CRawMemPool* block_pool=NULL);
+    ~CIoBuffer();
+
+    /** 得到数据的字节数 */
+    size_t size() const { return _size; }
+    bool empty() const { return 0 == _size; }
+
+    /** 得到片段个数，以及第index个片段的数据 */
+    size_t get_slice_number() const { return _slices.size(); }
+    const char* get_slice(size_t index, size_t* size) const;
+
+    /** 复制数据追加到尾部，先填满尾块的空闲空间 */
+    void append(const char* data, size_t size);
+
+    /** 将other的所有数据移到尾部，不复制，other被清空 */
+    void append(CIoBuffer* other);
+
+    /***
+      * 引用外部内存追加到尾部，不复制
+      * @release: 所有引用都释放后被调用，为NULL表示调用者自己管理内存，须在所有引用释放前保持有效
+      */
+    void append_external(const char* data, size_t size, io_release_t release, void* context);
+
+    /** 在头部插入数据，首块前有空闲空间时直接写入 */
+    void prepend(const char* data, size_t size);
+
+    /***
+      * 将从offset开始的size个字节追加到out，和本缓冲区共享块，不复制
+      * @return: 如果超出范围则返回false
+      */
+    bool slice(size_t offset, size_t size, CIoBuffer* out) const;
+
+    /** 将头部size个字节移到out，不复制，超出范围时返回false */
+    bool split(size_t size, CIoBuffer* out);
+
+    /** 丢弃头部的size个字节，超过时全部丢弃 */
+    void drain(size_t size);
+    void clear();
+
+    /** 从offset处复制size个字节到dest，超出范围时返回false */
+    bool copy_out(char* dest, size_t offset, size_t size) const;
+
+    /***
+      * 使头部size个字节连续（如解析消息头），只在跨片段时复制
+      * @return: 指向连续数据的指针，超出范围时返回NULL
+      */
+    const char* pullup(size_t size);
+
+    /** 从头开始填充最多iovcnt个iovec，返回填充的个数 */
+    int get_iovec(struct iovec* iov, int iovcnt) const;
+
+    /***
+      * 以readv从connector收到尾部，先填满尾块的空闲空间，余下的收到新块
+      * @return: 同Connector::readv，收到的字节数，对端关闭为0，非阻塞连接无数据为-1
+      * @exception: 网络错误时由connector抛出CSyscallException异常
+      */
+    template <class Connector>
+    ssize_t read_from(Connector* connector)
+    {
+        struct iovec iov[2];
+        const int iovcnt = prepare_read(iov);
+        const ssize_t bytes = connector->readv(iov, iovcnt);
+        if (bytes > 0)
+            commit_read(static_cast<size_t>(bytes));
+        return bytes;
+    }
+
+    /***
+      * 以writev发送，每次最多IOV_MAX个片段，已发送的被丢弃
+      * @return: 同Connector::writev，非阻塞连接不能发送时为-1，没有数据时为0
+      */
+    template <class Connector>
+    ssize_t write_to(Connector* connector)
+    {
+        struct iovec iov[IOV_MAX];
+        const int iovcnt = get_iovec(iov, IOV_MAX);
+        if (0 == iovcnt)
+            return 0;
+
+        const ssize_t bytes = connector->writev(iov, iovcnt);
+        if (bytes > 0)
+            drain(static_cast<size_t>(bytes));
+        return bytes;
+    }
+
+    /***
+      * 取出头部的一个片段，片段对块的引用转移给调用者，须以release_slice释放，
+      * 用于将片段交给以回调释放内存的模块（如CSendMachine::push），
+      * 其中data和size即为片段的数据
+      * @return: 缓冲区为空时返回false
+      */
+    bool pop_slice(const char** data, size_t* size, void** context);
+
+    /** 释放pop_slice取出的片段，签名同io_release_t */
+    static void release_slice(const char* data, size_t size, void* context);
+
+private:
+    CIoBuffer(const CIoBuffer&);
+    CIoBuffer& operator =(const CIoBuffer&);
+
+    struct Block
+    {
+        uint32_t refcount;
+        uint32_t capacity;
+        char* data;
+        sys::CRawMemPool* pool; /** 从中分配的池，为NULL表示从堆上分配或是外部内存 */
+        bool external;          /** 是否是外部内存 */
+        io_release_t release; /** 外部内存的释放回调 */
+        void* context;
+    };
+
+    struct Slice
+    {
+        Block* block;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+private:
+    Block* allocate_block();
+    static void ref_block(Block* block);
+    static void unref_block(Block* block);
+    bool is_writable(const Slice& slice) const;
+    int prepare_read(struct iovec* iov);
+    void commit_read(size_t bytes);
+
+private:
+    sys::CRawMemPool* _block_pool;
+    uint32_t _block_size;       /** 块的数据容量 */
+    std::deque<Slice> _slices;
+    size_t _size;
+    Block* _spare_block;        /** read_from时预先分配的下一个块 */
+    bool _read_into_tail;       /** prepare_read时是否用了尾块的空闲空间 */
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_IO_BUFFER_H
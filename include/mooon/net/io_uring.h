@@ -0,0 +1,178 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_IO_URING_H
+#define MOOON_NET_IO_URING_H
+#include "mooon/net/config.h"
+#include "mooon/sys/syscall_exception.h"
+#include <deque>
+#include <sys/uio.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 基于io_uring系统调用的同步I/O，不依赖liburing。
+  * 每个操作提交一个SQE并等待其完成，需要超时时链接一个IORING_OP_LINK_TIMEOUT，
+  * 一次io_uring_enter同时完成提交和等待，取代poll加recv/send两次系统调用，
+  * 配合MSG_WAITALL，full_receive/full_send通常一次系统调用即可完成。
+  *
+  * 非线程安全，通常一个线程一个，可用get_thread_ring得到本线程的实例。
+  * 操作的返回值同对应的系统调用，但出错时返回负的错误码而不是-1，
+  * 超时返回-ETIMEDOUT，超时前已部分完成时返回已完成的字节数。
+  */
+class CIoUring
+{
+public:
+    CIoUring();
+    ~CIoUring();
+
+    /** 判断内核是否支持io_uring（包括是否被io_uring_disabled禁用） */
+    static bool is_supported();
+
+    /***
+      * 得到调用线程的io_uring实例，第一次调用时创建，线程退出时自动销毁
+      * @return: 如果不支持io_uring，则返回NULL
+      */
+    static CIoUring* get_thread_ring();
+
+    /***
+      * 创建io_uring
+      * @entries: 提交队列大小
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(uint32_t entries=64);
+    void destroy();
+    bool is_created() const { return _ring_fd != -1; }
+
+    /***
+      * 收发数据，milliseconds为0表示不超时
+      * @flags: 同recv/send的flags，如MSG_WAITALL表示收或发完整个缓冲区才完成
+      */
+    int recv(int fd, void* buffer, size_t buffer_size, int flags, uint32_t milliseconds=0);
+    int send(int fd, const void* buffer, size_t buffer_size, int flags, uint32_t milliseconds=0);
+    int readv(int fd, const struct iovec* iov, int iovcnt, uint32_t milliseconds=0);
+    int writev(int fd, const struct iovec* iov, int iovcnt, uint32_t milliseconds=0);
+
+    /***
+      * 注册固定缓冲区，内核一次性锁定并映射这些内存，之后read_fixed/write_fixed不再逐次映射
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void register_buffers(const struct iovec* iov, uint32_t iovcnt);
+    void unregister_buffers();
+
+    /***
+      * 以第buffer_index个固定缓冲区中的[buffer, buffer+buffer_size)读写，
+      * buffer必须在该固定缓冲区内
+      */
+    int read_fixed(int fd, void* buffer, size_t buffer_size, uint16_t buffer_index, uint32_t milliseconds=0);
+    int write_fixed(int fd, const void* buffer, size_t buffer_size, uint16_t buffer_index, uint32_t milliseconds=0);
+
+    /***
+      * 提供multishot接收使用的缓冲区，buffer被分成buffer_number个buffer_size大小的块，
+      * 收到的每段数据放在其中一块中，一个io_uring只支持一组
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void provide_buffers(char* buffer, uint32_t buffer_size, uint16_t buffer_number);
+
+    /***
+      * 开始在fd上multishot接收，之后只要有数据到达，内核就取一块提供的缓冲区接收，
+      * 不需要每次再提交，由wait_multishot_receive取得结果，一个io_uring同时只能在一个fd上
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void start_multishot_receive(int fd);
+
+    /***
+      * 等待multishot接收的下一段数据
+      * @data: 数据所在的块，用完后须调用recycle_buffer归还
+      * @buffer_id: 块的编号
+      * @more: 为false表示multishot已结束（如缓冲区用完或出错），需重新start_multishot_receive
+      * @return: 收到的字节数，对端关闭连接时为0，出错时为负的错误码，超时返回-ETIMEDOUT
+      */
+    int wait_multishot_receive(char** data, uint16_t* buffer_id, bool* more, uint32_t milliseconds=0);
+
+    /** 将块归还给内核，以便继续接收，随下一次wait_multishot_receive一起提交 */
+    void recycle_buffer(uint16_t buffer_id);
+
+    /***
+      * 异步的定位读写和fsync，只放入提交队列，由wait_completions一起提交并取得结果，
+      * 可同时有多个在途，在途的个数即为队列深度，不要超过create时entries的两倍（完成队列的大小）
+      * @offset: 文件中的偏移
+      * @tag: 调用者的标识，随完成事件返回，必须小于2^63
+      */
+    void queue_pread(int fd, void* buffer, size_t buffer_size, uint64_t offset, uint64_t tag);
+    void queue_pwrite(int fd, const void* buffer, size_t buffer_size, uint64_t offset, uint64_t tag);
+    void queue_fsync(int fd, bool datasync, uint64_t tag);
+
+    /***
+      * 提交所有排队的操作，并等待至少min_number个异步操作完成
+      * @tags: 存放已完成操作的tag
+      * @results: 存放已完成操作的结果，同pread、pwrite和fsync，但出错时为负的错误码
+      * @return: 取得的完成个数，不超过max_number，不支持io_uring时返回-ENOSYS
+      * @exception: 出错抛出CSyscallException异常
+      */
+    int wait_completions(uint64_t* tags, int* results, int max_number, int min_number);
+
+    /** 得到io_uring_enter的调用次数 */
+    uint64_t get_enter_number() const { return _enter_number; }
+
+private:
+    struct Completion
+    {
+        uint64_t user_data;
+        int32_t res;
+        uint32_t flags;
+    };
+
+private:
+    void* get_sqe(uint32_t reserve_number=1);
+    int execute(void* sqe, uint32_t milliseconds);
+    void submit(uint32_t wait_number, uint32_t milliseconds);
+    bool reap(Completion* completion);
+    void* prep_provide_buffers(char* buffer, uint16_t buffer_number, uint16_t buffer_id);
+    void* prep_file_io(uint8_t opcode, int fd, const void* buffer, size_t buffer_size, uint64_t offset, uint64_t tag);
+
+private:
+    int _ring_fd;
+    uint32_t _sq_entries;
+    uint32_t _cq_entries;
+    void* _sq_ring;
+    void* _cq_ring;
+    void* _sqes;
+    size_t _sq_ring_size;
+    size_t _cq_ring_size;
+    uint32_t* _sq_head;
+    uint32_t* _sq_tail;
+    uint32_t* _sq_mask;
+    uint32_t* _sq_array;
+    uint32_t* _cq_head;
+    uint32_t* _cq_tail;
+    uint32_t* _cq_mask;
+    void* _cqes;
+    uint32_t _sq_local_tail; /** 已填写但还未提交的SQE在_sq_local_tail之前 */
+    uint32_t _submit_number;
+    uint64_t _next_user_data;
+    uint64_t _enter_number;
+
+private:
+    char* _provided_buffer;     /** multishot接收用的缓冲区 */
+    uint32_t _provided_size;
+    std::deque<Completion> _multishot_completions; /** 同步操作等待期间收到的multishot完成事件 */
+    std::deque<Completion> _async_completions;     /** 同步操作等待期间收到的异步操作完成事件 */
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_IO_URING_H
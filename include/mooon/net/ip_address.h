@@ -23,6 +23,7 @@
 #include <utility> // std::pair
 #include "mooon/net/config.h"
 #include "mooon/sys/syscall_exception.h"
+#include "mooon/utils/hash_utils.h"
 NET_NAMESPACE_BEGIN
 
 /** IP地址，兼容IPV4和IPV6 */
@@ -75,6 +76,9 @@ public:
     /** 判断是否为广播地址 */
     bool is_broadcast_address() const;
 
+    /** 哈希值，各位充分混合，可直接用于按位与取桶的哈希表，不抛出异常 */
+    uint64_t hash_value() const;
+
 public: // 赋值和比较操作
     ip_address_t& operator =(uint32_t ipv4);
     ip_address_t& operator =(const uint32_t* ipv6);
@@ -198,13 +202,27 @@ inline bool ip_address_t::is_ipv6() const
     return _is_ipv6;
 }
 
+inline uint64_t ip_address_t::hash_value() const
+{
+    if (!_is_ipv6)
+        return utils::CHashUtils::mix64(_ip_data[0]);
+
+    const uint64_t high = (static_cast<uint64_t>(_ip_data[0]) << 32) | _ip_data[1];
+    const uint64_t low = (static_cast<uint64_t>(_ip_data[2]) << 32) | _ip_data[3];
+    return utils::CHashUtils::mix64(high ^ utils::CHashUtils::mix64(low));
+}
+
 /** ip_address_t类型的Hash函数 */
 typedef struct
 {
     uint64_t operator()(const ip_address_t* ip_address) const
     {
-        const uint32_t* address_data = ip_address->get_address_data();
-        return ip_address->is_ipv6()? (address_data[1] + address_data[3]): address_data[0];
+        return ip_address->hash_value();
+    }
+
+    uint64_t operator()(const ip_address_t& ip_address) const
+    {
+        return ip_address.hash_value();
     }
 }ip_address_hasher;
 
@@ -230,4 +248,16 @@ typedef std::pair<ip_address_t, port_t> ip_port_pair_t;
 typedef std::vector<ip_port_pair_t> ip_port_pair_array_t;
 
 NET_NAMESPACE_END
+
+// 使ip_address_t可直接用作std::unordered_map和utils::CFlatHashMap等的键
+namespace std {
+template <>
+struct hash<mooon::net::ip_address_t>
+{
+    size_t operator()(const mooon::net::ip_address_t& ip_address) const
+    {
+        return static_cast<size_t>(ip_address.hash_value());
+    }
+};
+} // namespace std
 #endif // MOOON_NET_IP_ADDRESS_H
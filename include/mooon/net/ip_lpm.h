@@ -0,0 +1,284 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_IP_LPM_H
+#define MOOON_NET_IP_LPM_H
+#include "mooon/net/ip_address.h"
+#include <arpa/inet.h>
+#include <map>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+/***
+  * IPV4的最长前缀匹配表，DIR-24-8结构（同DPDK的rte_lpm）：
+  * 地址的高24位直接索引一个2^24项的一级表，前缀长度不超过24的路由展开到一级表中；
+  * 长于24位的路由所在的一级表项指向一个256项的二级表组，由低8位索引，
+  * 因此任何查找最多两次访存，与路由条数无关。
+  *
+  * 每项4字节：最高位为有效标志，次高位表示一级表项指向二级表组，
+  * 接下来6位为该项所属路由的前缀长度（增删时据此判断是否被更长的前缀覆盖），低24位为下一跳或二级表组的下标，
+  * 因此下一跳不能超过0xFFFFFF（可以是另一张表的下标），二级表组最多2^24个。
+  * 一级表固定占64MB，二级表组按需分配，删除路由后不再需要的组被回收。
+  *
+  * 地址为网络字节序（与string_toipv4和ip_address_t::to_ipv4一致），
+  * 查找不修改任何状态，可多线程同时查找，但增删须与查找互斥（或增删时使用另一张表，完成后切换）。
+  *
+  * 使用示例：
+  * CIpv4LpmTable table;
+  * uint32_t ip, next_hop;
+  * CUtils::string_toipv4("10.0.0.0", ip);
+  * table.insert(ip, 8, 1);
+  * CUtils::string_toipv4("10.1.2.3", ip);
+  * if (table.lookup(ip, &next_hop)) ... // next_hop为1
+  */
+class CIpv4LpmTable
+{
+public:
+    enum { MAX_NEXT_HOP = 0xFFFFFF };
+
+public:
+    CIpv4LpmTable();
+
+    /***
+      * 增加或更新一条路由
+      * @ip: 前缀，网络字节序，前缀长度之后的位被忽略
+      * @depth: 前缀长度，0到32，0为默认路由
+      * @exception: depth大于32或next_hop大于MAX_NEXT_HOP时抛出utils::CException异常
+      */
+    void insert(uint32_t ip, uint8_t depth, uint32_t next_hop);
+
+    /** 删除一条路由，不存在时返回false */
+    bool remove(uint32_t ip, uint8_t depth);
+
+    /** 删除所有路由 */
+    void clear();
+
+    /** 查找最长匹配的路由，没有匹配的返回false */
+    bool lookup(uint32_t ip, uint32_t* next_hop) const
+    {
+        const uint32_t host_ip = ntohl(ip);
+        uint32_t entry = _tbl24[host_ip >> 8];
+        if (entry & ENTRY_EXTENDED)
+            entry = _tbl8[((entry & ENTRY_VALUE_MASK) << 8) | (host_ip & 0xFF)];
+        if (0 == (entry & ENTRY_VALID))
+            return false;
+
+        *next_hop = entry & ENTRY_VALUE_MASK;
+        return true;
+    }
+
+    bool lookup(const ip_address_t& ip, uint32_t* next_hop) const
+    {
+        return !ip.is_ipv6() && lookup(ip.to_ipv4(), next_hop);
+    }
+
+    /***
+      * 批量查找，连续的地址交替访问两级表，使访存相互重叠
+      * @found: 为NULL时不输出，否则found[i]表示ips[i]是否找到，没找到的next_hops[i]不变
+      * @return: 找到的个数
+      */
+    size_t lookup(const uint32_t* ips, size_t count, uint32_t* next_hops, bool* found) const;
+
+    /** 路由条数 */
+    size_t size() const { return _rules.size(); }
+
+    /** 正在使用的二级表组数 */
+    size_t get_tbl8_group_number() const { return (_tbl8.size() >> 8) - _free_groups.size(); }
+
+private:
+    enum
+    {
+        ENTRY_VALID = 0x80000000,
+        ENTRY_EXTENDED = 0x40000000,
+        ENTRY_DEPTH_SHIFT = 24,
+        ENTRY_DEPTH_MASK = 0x3F000000,
+        ENTRY_VALUE_MASK = 0x00FFFFFF
+    };
+
+    static uint32_t make_entry(uint8_t depth, uint32_t next_hop)
+    {
+        return ENTRY_VALID | (static_cast<uint32_t>(depth) << ENTRY_DEPTH_SHIFT) | next_hop;
+    }
+
+    static uint8_t get_depth(uint32_t entry)
+    {
+        return static_cast<uint8_t>((entry & ENTRY_DEPTH_MASK) >> ENTRY_DEPTH_SHIFT);
+    }
+
+    // 以主机字节序的前缀和长度为键，前缀长度之后的位为0
+    static uint64_t rule_key(uint32_t prefix, uint8_t depth)
+    {
+        return (static_cast<uint64_t>(prefix) << 8) | depth;
+    }
+
+    // 覆盖[prefix, prefix+2^(32-depth))的范围内，前缀长度不超过depth的项改为entry；
+    // removing时entry为被删除的路由所覆盖的更短前缀的项（没有时为0，即无效），只替换前缀长度等于depth的项
+    void fill(uint32_t prefix, uint8_t depth, uint32_t entry, bool removing);
+    void fill_tbl8(uint32_t group, uint32_t first, uint32_t last, uint8_t depth, uint32_t entry, bool removing);
+    uint32_t allocate_group(uint32_t entry);
+    void try_reclaim_group(uint32_t index24);
+
+    // 最长的前缀长度小于depth且覆盖prefix的路由，没有时返回0（无效项）
+    uint32_t find_parent_entry(uint32_t prefix, uint8_t depth) const;
+
+private:
+    std::vector<uint32_t> _tbl24;
+    std::vector<uint32_t> _tbl8;
+    std::vector<uint32_t> _free_groups;
+    std::map<uint64_t, uint32_t> _rules; // 所有路由，删除时据此找到被覆盖的更短的前缀
+};
+
+/***
+  * IPV6的最长前缀匹配表，Poptrie结构（Asai & Ohara, SIGCOMM 2015）：
+  * 高16位直接索引一个2^16项的表（direct pointing），之后每6位一层，
+  * 每个内部结点只有两个64位的位图和两个基址：vector的第v位表示第v个子是内部结点，
+  * leafvec标记叶子值发生变化的位置，子结点和叶子分别连续存放，
+  * 第v个子结点的下标为base1+popcount(vector的低v+1位)-1，叶子同理，
+  * 相同的相邻叶子只存一份，结点小且连续，一次查找最多访问1+19个结点，与路由条数无关。
+  *
+  * 结构是紧凑且只读的，insert和remove只修改路由集合，须调用build重建后才对lookup生效，
+  * 适合批量加载后很少变化的表（ACL、地理位置库、路由表快照）；
+  * build期间的lookup使用旧的结构，但两者须互斥（或在另一个对象上build后切换）。
+  * 地址为网络字节序的16字节（与string_toipv6和ip_address_t::to_ipv6一致），下一跳不能超过MAX_NEXT_HOP。
+  */
+class CIpv6LpmTable
+{
+public:
+    enum { MAX_NEXT_HOP = 0x7FFFFFFE };
+
+public:
+    CIpv6LpmTable();
+
+    /***
+      * 增加或更新一条路由，调用build后生效
+      * @depth: 前缀长度，0到128
+      * @exception: depth大于128或next_hop大于MAX_NEXT_HOP时抛出utils::CException异常
+      */
+    void insert(const uint32_t* ip, uint8_t depth, uint32_t next_hop);
+
+    /** 删除一条路由，调用build后生效，不存在时返回false */
+    bool remove(const uint32_t* ip, uint8_t depth);
+
+    /** 删除所有路由，调用build后生效 */
+    void clear();
+
+    /** 由路由集合重建查找结构 */
+    void build();
+
+    /** 查找最长匹配的路由，没有匹配的返回false */
+    bool lookup(const uint32_t* ip, uint32_t* next_hop) const
+    {
+        const uint64_t high = load_be64(ip);
+        const uint64_t low = load_be64(ip+2);
+        uint32_t entry = _direct[high >> 48];
+        uint32_t offset = 16;
+
+        while (entry & DIRECT_NODE)
+        {
+            const struct Node& node = _nodes[entry & ~DIRECT_NODE];
+            const uint32_t v = extract6(high, low, offset);
+            const uint64_t mask = (2ULL << v) - 1; // 低v+1位，v为63时溢出为全1
+            if (node.vector & (1ULL << v))
+            {
+                entry = DIRECT_NODE | (node.base1 + __builtin_popcountll(node.vector & mask) - 1);
+                offset += 6;
+            }
+            else
+            {
+                entry = _leaves[node.base0 + __builtin_popcountll(node.leafvec & mask) - 1];
+                break;
+            }
+        }
+
+        if (NO_ROUTE == entry)
+            return false;
+        *next_hop = entry;
+        return true;
+    }
+
+    bool lookup(const ip_address_t& ip, uint32_t* next_hop) const
+    {
+        return ip.is_ipv6() && lookup(ip.to_ipv6(), next_hop);
+    }
+
+    /** 路由条数（包括还未build的） */
+    size_t size() const { return _rules.size(); }
+
+    /** 内部结点数和叶子数，可据此估算内存 */
+    size_t get_node_number() const { return _nodes.size(); }
+    size_t get_leaf_number() const { return _leaves.size(); }
+
+private:
+    // 直接表的项最高位为1时低31位为结点的下标，否则和叶子一样为下一跳或NO_ROUTE
+    enum { NO_ROUTE = 0x7FFFFFFF, DIRECT_NODE = 0x80000000 };
+
+    struct Node
+    {
+        uint64_t vector;  // 第v位为1表示第v个子是内部结点
+        uint64_t leafvec; // 第v位为1表示第v个子是叶子，且与之前最近的叶子的值不同
+        uint32_t base0;   // 叶子在_leaves中的起始下标
+        uint32_t base1;   // 子结点在_nodes中的起始下标
+    };
+
+    // 路由的键，前缀为主机字节序的高64位和低64位，前缀长度之后的位为0
+    struct Prefix
+    {
+        uint64_t high;
+        uint64_t low;
+        uint8_t depth;
+
+        bool operator <(const Prefix& other) const
+        {
+            if (high != other.high) return high < other.high;
+            if (low != other.low) return low < other.low;
+            return depth < other.depth;
+        }
+    };
+
+    typedef std::map<Prefix, uint32_t> rule_table_t;
+    typedef rule_table_t::value_type Rule;
+
+    static uint64_t load_be64(const uint32_t* ip)
+    {
+        return (static_cast<uint64_t>(ntohl(ip[0])) << 32) | ntohl(ip[1]);
+    }
+
+    // 取第offset位（从最高位算起）开始的6位，超出128位的部分为0
+    static uint32_t extract6(uint64_t high, uint64_t low, uint32_t offset)
+    {
+        if (offset <= 58)
+            return static_cast<uint32_t>(high >> (58 - offset)) & 0x3F;
+        if (offset < 64)
+            return static_cast<uint32_t>((high << (offset - 58)) | (low >> (122 - offset))) & 0x3F;
+        if (offset <= 122)
+            return static_cast<uint32_t>(low >> (122 - offset)) & 0x3F;
+        return static_cast<uint32_t>(low << (offset - 122)) & 0x3F;
+    }
+
+    static Prefix make_prefix(const uint32_t* ip, uint8_t depth);
+    uint32_t build_node(const std::vector<const Rule*>& rules, uint32_t offset, uint32_t inherited, uint32_t index);
+
+private:
+    std::vector<uint32_t> _direct;
+    std::vector<struct Node> _nodes;
+    std::vector<uint32_t> _leaves;
+    rule_table_t _rules;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_IP_LPM_H
@@ -131,7 +131,7 @@ typedef struct ip_node_t
     ip_node_t(uint16_t new_port, const ip_address_t& new_ip);
     ip_node_t(const ip_node_t& other);
     ip_node_t& operator =(const ip_node_t& other);
-    bool operator ==(const ip_node_t& other);       
+    bool operator ==(const ip_node_t& other) const;
 }ip_node_t;
 
 inline ip_node_t::ip_node_t()
@@ -158,7 +158,7 @@ inline ip_node_t& ip_node_t::operator =(const ip_node_t& other)
     return *this;
 }
 
-inline bool ip_node_t::operator ==(const ip_node_t& other)
+inline bool ip_node_t::operator ==(const ip_node_t& other) const
 {
     return ip == other.ip && port == other.port;
 }
@@ -198,7 +198,7 @@ typedef struct
 {
     bool operator()(const ipv6_node_t& lhs, const ipv6_node_t& rhs) const
     {
-		return (lhs.port == rhs.port) && (0 == memcmp(lhs.ip, rhs.ip, sizeof(ipv6_node_t)));
+		return (lhs.port == rhs.port) && (0 == memcmp(lhs.ip, rhs.ip, sizeof(lhs.ip)));
 	}
 }ipv6_node_comparer;
 
@@ -207,13 +207,7 @@ typedef struct
 {
     uint64_t operator()(const ip_node_t& ip_node) const
     {
-        const uint32_t* ip_data = ip_node.ip.get_address_data();
-
-        return ip_data[0]
-        + ip_data[1]
-        + ip_data[2]
-        + ip_data[3]
-        + ip_node.port;
+        return utils::CHashUtils::mix64(ip_node.ip.hash_value() + ip_node.port);
     }
 }ip_node_hasher;
 
@@ -226,5 +220,27 @@ typedef struct
     }
 }ip_node_comparer;
 
+/** IP的小于比较函数，用作std::map的Compare */
+typedef struct
+{
+    bool operator()(const ip_node_t& lhs, const ip_node_t& rhs) const
+    {
+        if (lhs.port != rhs.port)
+            return lhs.port < rhs.port;
+        return memcmp(lhs.ip.get_address_data(), rhs.ip.get_address_data(), sizeof(uint32_t)*4) < 0;
+    }
+}ip_node_less;
+
 NET_NAMESPACE_END
+
+namespace std {
+template <>
+struct hash<mooon::net::ip_node_t>
+{
+    size_t operator()(const mooon::net::ip_node_t& ip_node) const
+    {
+        return static_cast<size_t>(mooon::net::ip_node_hasher()(ip_node));
+    }
+};
+} // namespace std
 #endif // MOOON_NET_IP_NODE_H
@@ -5,12 +5,15 @@
 #include <mooon/net/config.h>
 #include <mooon/utils/scoped_ptr.h>
 #include <librdkafka/rdkafkacpp.h>
+#include <map>
+#include <vector>
 NET_NAMESPACE_BEGIN
 
 class DefEventImpl;
 class DefConsumeImpl;
 class DefRebalanceImpl;
 class DefOffsetCommitImpl;
+class CKafkaPartitionWorker;
 
 struct MessageInfo
 {
@@ -19,6 +22,47 @@ struct MessageInfo
     std::string topicname;
 };
 
+// 批量消费得到的消息，直接引用librdkafka的消息而不复制，
+// 消息在批析构或clear时才释放，所以get_data返回的指针只在此之前有效。
+class CKafkaMessageBatch
+{
+public:
+    CKafkaMessageBatch() {}
+    ~CKafkaMessageBatch() { clear(); }
+
+    // 释放批中所有消息
+    void clear();
+    int size() const { return static_cast<int>(_messages.size()); }
+    bool empty() const { return _messages.empty(); }
+
+    const char* get_data(int i) const { return static_cast<const char*>(_messages[i]->payload()); }
+    size_t get_size(int i) const { return _messages[i]->len(); }
+    int32_t get_partition(int i) const { return _messages[i]->partition(); }
+    int64_t get_offset(int i) const { return _messages[i]->offset(); }
+    int64_t get_timestamp(int i) const { return _messages[i]->timestamp().timestamp; }
+    const RdKafka::Message* get_message(int i) const { return _messages[i]; }
+
+private:
+    CKafkaMessageBatch(const CKafkaMessageBatch&);
+    CKafkaMessageBatch& operator =(const CKafkaMessageBatch&);
+
+private:
+    friend class CKafkaConsumer;
+    std::vector<RdKafka::Message*> _messages;
+};
+
+// 分区并行消费的处理器，
+// handle在分区的工作线程中被调用，同一分区的消息按offset顺序交给handle，不同分区并行处理。
+class IKafkaPartitionHandler
+{
+public:
+    virtual ~IKafkaPartitionHandler() {}
+
+    // handle返回即视为batch中的消息已处理完，它们的offset之后会被提交，
+    // batch在handle返回后释放，不能保留其中的指针
+    virtual void handle(int32_t partition, const CKafkaMessageBatch& batch) = 0;
+};
+
 // 注：一个CKafkaConsumer实例只能消费一个topic，
 // 被消息的topic由init成员函数指定。
 class CKafkaConsumer
@@ -46,6 +90,25 @@ public:
     bool consume(std::string* log, int timeout_ms=1000, struct MessageInfo* mi=NULL);
     int consume_batch(int batch_size, std::vector<std::string>* logs, int timeout_ms=1000, struct MessageInfo* mi=NULL);
 
+    // 零拷贝的批量消费，消息保存在batch中，batch原有的消息先被释放
+    // 返回消费到的消息数
+    int consume_batch(int batch_size, CKafkaMessageBatch* batch, int timeout_ms=1000);
+
+    // 启动分区并行消费，每个分区一个工作线程，在第一次收到该分区的消息时创建，
+    // 之后须由一个线程循环调用dispatch_batch，而不能再调用consume和consume_batch。
+    //
+    // 只提交已处理完的offset，因此init时enable_auto_commit须为false，
+    // 再平衡时工作线程中未处理完的消息可能被新的消费者再次消费（至少一次）。
+    // max_pending_batches为一个分区最多积压的批数，积压满时dispatch_batch阻塞等待。
+    void start_partition_workers(IKafkaPartitionHandler* handler, int max_pending_batches=100);
+
+    // 消费一批消息，按分区分派给工作线程，并以async_commit提交各分区已处理完的offset
+    // 返回分派的消息数
+    int dispatch_batch(int batch_size, int timeout_ms=1000);
+
+    // 等待已分派的消息处理完，同步提交offset后停止所有工作线程
+    void stop_partition_workers();
+
     // 同步阻塞提交
     // 返回RdKafka::ERR_NO_ERROR表示成功，其它出错
     int sync_commit();
@@ -54,6 +117,10 @@ public:
     // 返回RdKafka::ERR_NO_ERROR表示成功，其它出错
     int async_commit();
 
+private:
+    int consume_messages(int batch_size, int timeout_ms, std::vector<RdKafka::Message*>* messages);
+    int commit_processed(bool sync);
+
 private:
     std::string _brokers_str;
     std::string _topic_str;
@@ -73,6 +140,11 @@ private:
 
 private:
     std::string _auto_offset_reset;
+
+private:
+    IKafkaPartitionHandler* _partition_handler;
+    int _max_pending_batches;
+    std::map<int32_t, CKafkaPartitionWorker*> _partition_workers;
 };
 
 NET_NAMESPACE_END
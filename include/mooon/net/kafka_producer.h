@@ -3,14 +3,48 @@
 #define MOOON_NET_KAFKA_PRODUCER_H
 #if MOOON_HAVE_LIBRDKAFKA==1 // 宏MOOON_HAVE_LIBRDKAFKA的值须为1
 #include <mooon/net/config.h>
+#include <mooon/sys/disk_queue.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/log.h>
+#include <mooon/sys/thread_engine.h>
 #include <mooon/utils/scoped_ptr.h>
 #include <librdkafka/rdkafkacpp.h>
+#include <deque>
+#include <map>
 NET_NAMESPACE_BEGIN
 
+// produce_nocopy的释放回调，消息递送成功或失败后在poll中被调用，
+// 入队失败时不会被调用，由调用者自行释放
+typedef void (*kafka_release_t)(const char* log, size_t log_size, void* context);
+
+// 每个分区的递送统计
+struct KafkaPartitionStats
+{
+    uint64_t inflight_number;   // 已入队还未收到递送报告的消息数，按produce时指定的分区计，未指定的计在PARTITION_UA下
+    uint64_t delivered_number;  // 递送成功的消息数，以下均按实际分区计
+    uint64_t delivered_bytes;
+    uint64_t error_number;      // 递送失败（如超时）的消息数
+    uint64_t total_latency_us;  // 从入队到收到递送报告的总微秒数，除以递送成功和失败的消息数即为平均延迟
+    uint64_t max_latency_us;
+};
+
+// 生产者的统计
+struct KafkaProducerStats
+{
+    uint64_t produced_number;   // 成功入队的消息数
+    uint64_t produce_error_number; // 入队失败的消息数
+    uint64_t inflight_number;
+    uint64_t spooled_number;    // 写入溢出暂存队列的消息数（入队时队列满或递送失败），见set_spool
+    uint64_t replayed_number;   // 从溢出暂存队列重新入队的消息数
+    int queue_depth;            // librdkafka队列中的消息和请求数（outq_len）
+    std::map<int32_t, KafkaPartitionStats> partitions;
+};
+
 class DefDeliveryReportImpl;
 class DefEventImpl;
 class DefPartitionerImpl;
+class CDeliveryReportDispatcher;
 
 // 非线程安全
 // 一个CKafkaProducer只能处理一个topic
@@ -22,9 +56,23 @@ public:
     // 如果dr_cb为空，则使用DefDeliveryReportImpl作为DeliveryReportCb，每个消息递送成功或失败（如超时）均会调用一次dr_cb，
     // 如果event_cb为空，则使用DefEventImpl作为EventCb，
     // 如果partitioner_cb为空，则使用DefPartitionerImpl作为PartitionerCb。
+    // 消息的msg_opaque由CKafkaProducer用于统计，dr_cb中不应使用。
     CKafkaProducer(RdKafka::DeliveryReportCb* dr_cb=NULL, RdKafka::EventCb* event_cb=NULL, RdKafka::PartitionerCb* partitioner_cb=NULL);
+    ~CKafkaProducer();
     bool init(const std::string& brokers_str, const std::string& topic_str, std::string* errmsg=NULL);
 
+    // 设置librdkafka的全局配置和topic配置，须在init之前调用，在init时生效，
+    // 不合法的配置导致init失败
+    void set_global_config(const std::string& name, const std::string& value);
+    void set_topic_config(const std::string& name, const std::string& value);
+
+    // 高吞吐配置，须在init之前调用：
+    // linger_ms 消息在本地最多攒多少毫秒再成批发出（queue.buffering.max.ms），越大批越大
+    // batch_num_messages 一批最多的消息数（batch.num.messages）
+    // compression_codec 压缩方式（compression.codec），可为none、gzip、snappy、lz4或zstd，按批压缩
+    // queue_max_messages 本地队列最多的消息数（queue.buffering.max.messages）
+    void set_batching(int linger_ms, int batch_num_messages, const std::string& compression_codec="lz4", int queue_max_messages=1000000);
+
     // 调用produce并不一定立即发送消息，而是将消息放到发送队列中缓存，
     // 发送队列大小由配置queue.buffering.max.message指定，如果队列满应调用poll去触发消息发送。
     //
@@ -44,8 +92,37 @@ public:
 
     // errcode和errmsg存储最近一次的出错信息
     // 返回实际数，为0表示一个也没有
+    // 以librdkafka的rd_kafka_produce_batch一次入队，只需取一次队列锁，
+    // 入队失败的消息不影响其它消息，返回值和errcode同上
     int produce_batch(const std::string& key, const std::vector<std::string>& logs, int32_t partition=RdKafka::Topic::PARTITION_UA, int* errcode=NULL, std::string* errmsg=NULL);
 
+    // 零拷贝入队，librdkafka直接引用log而不复制，
+    // 在递送报告（成功或失败）时调用release，之前log必须保持有效且不被修改，
+    // 返回值和errcode同produce，返回false时release不会被调用
+    bool produce_nocopy(const std::string& key, const char* log, size_t log_size, kafka_release_t release, void* context,
+                        int32_t partition=RdKafka::Topic::PARTITION_UA, int* errcode=NULL, std::string* errmsg=NULL);
+
+    // 设置溢出暂存队列，Kafka不可用时数据暂存到磁盘，恢复后再重放，既不阻塞生产者也不丢数据，
+    // spool由调用者打开和关闭，须在CKafkaProducer销毁前一直有效，为NULL表示不暂存（默认）：
+    // 1) produce和produce_batch入队时队列满（ERR__QUEUE_FULL），消息写入spool，返回成功；
+    // 2) 递送失败（如超时）的消息写入spool，包括produce_nocopy的，写入后才调用release；
+    // 3) spool不为空时，后续produce的消息也写入spool，保持大致的先后顺序；
+    // 4) timed_poll时从spool中重新入队最多replay_batch个，队列满时停止，
+    //    最近一次递送失败后retry_interval_ms毫秒内不重放，避免Kafka不可用时反复入队和超时。
+    // 暂存的记录为4字节的key长度、key和消息，重放时按key重新分区，不保留produce时指定的分区；
+    // spool满（达到max_segments）或写磁盘出错时同没有spool。
+    // 对spool的访问已加锁，spool和has_spooled可被其它线程调用（见CAsyncKafkaProducer）
+    void set_spool(mooon::sys::CDiskQueue* spool, int replay_batch=1000, int retry_interval_ms=1000);
+
+    // 直接写入spool，之后由timed_poll按序重放，没有spool或spool满时返回false，可被任意线程调用
+    bool spool(const std::string& key, const std::string& log);
+
+    // spool中是否有待重放的消息，可被任意线程调用
+    bool has_spooled() const;
+
+    // 取统计，可被任意线程调用
+    void get_stats(KafkaProducerStats* stats) const;
+
     // librdkafka要求定时调用timed_poll，
     // 否则事件不会被回调，消息会被积压（发送队列满，但因为没调用poll，即使数据已发送出去，然而发送队列的状态值没有改变）。
     // 返回回调的次数（RdKafka::DeliveryCb、RdKafka::EventCb）。
@@ -56,6 +133,16 @@ public:
     // 会触发回调
     int flush(int timeout_ms);
 
+private:
+    friend class CDeliveryReportDispatcher;
+    struct Tracker;
+    bool set_configs(const std::map<std::string, std::string>& configs, RdKafka::Conf* conf, std::string* errmsg);
+    Tracker* new_tracker(int32_t partition, kafka_release_t release, void* context);
+    void on_produce(Tracker* tracker, RdKafka::ErrorCode errcode);
+    void on_delivery(RdKafka::Message& message);
+    bool spool_message(const void* key, size_t key_size, const void* log, size_t log_size);
+    void replay_spool();
+
 private:
     std::string _brokers_str;
     std::string _topic_str;
@@ -70,6 +157,117 @@ private:
     mooon::utils::ScopedPtr<RdKafka::DeliveryReportCb> _dr_cb;
     mooon::utils::ScopedPtr<RdKafka::EventCb> _event_cb;
     mooon::utils::ScopedPtr<RdKafka::PartitionerCb> _partitioner_cb;
+    mooon::utils::ScopedPtr<CDeliveryReportDispatcher> _dr_dispatcher; // 统计后再转给_dr_cb
+
+private:
+    std::map<std::string, std::string> _global_configs;
+    std::map<std::string, std::string> _topic_configs;
+
+private:
+    mutable mooon::sys::CLock _stats_lock;
+    uint64_t _produced_number;
+    uint64_t _produce_error_number;
+    std::map<int32_t, KafkaPartitionStats> _partition_stats;
+    uint64_t _spooled_number;
+    uint64_t _replayed_number;
+
+private:
+    mutable mooon::sys::CLock _spool_lock; // 保护_spool
+    mooon::sys::CDiskQueue* _spool;
+    int _replay_batch;
+    int _retry_interval_ms;
+    uint64_t _last_delivery_error_us; // 最近一次递送失败的单调时钟微秒数
+};
+
+// 异步生产者的统计
+struct AsyncKafkaProducerStats
+{
+    uint64_t accepted_number;   // produce接受的消息数（包括溢出到spool的）
+    uint64_t spilled_number;    // 因内存超预算而溢出到spool的消息数
+    uint64_t dropped_number;    // 内存超预算且没有spool（或spool满）而丢弃的消息数
+    uint64_t buffered_number;   // 当前内存中等待入队的消息数
+    uint64_t buffered_bytes;    // 当前内存中的字节数，包括后台线程正在入队的，不超过memory_budget
+    uint64_t max_buffered_bytes;
+    uint64_t total_queue_latency_us; // 从produce到交给librdkafka的总微秒数，除以accepted_number-spilled_number即为平均
+    uint64_t max_queue_latency_us;
+};
+
+// CKafkaProducer的异步前端，produce只把消息放入内存，由后台线程交给CKafkaProducer并调用timed_poll，
+// 不管Kafka是否可用，produce的耗时都是固定的（复制一次消息），调用者也不需要调用timed_poll：
+// 1) 内存中的消息总字节数不超过memory_budget（硬性上限），超过时消息溢出到CKafkaProducer的spool（见set_spool），
+//    溢出开始后，在spool重放完之前，后续的消息也溢出到spool，按写入spool的顺序重放；
+//    溢出开始时已在内存中的消息由后台线程交给CKafkaProducer，因spool不为空也写入spool，排在溢出的消息之后
+// 2) librdkafka队列占用的内存由CKafkaProducer的set_batching（queue.buffering.max.messages）
+//    或set_global_config("queue.buffering.max.kbytes", ...)限制，队列满时CKafkaProducer写入spool
+// 3) 没有spool时，超预算的消息被丢弃，produce返回false
+// 4) 度量kafka.async_spilled、kafka.async_dropped、kafka.async_buffered_bytes和
+//    kafka.async_queue_latency_ns（从produce到交给librdkafka）注册在CMetricsRegistry中
+//
+// produce可被任意线程调用，CKafkaProducer只由后台线程调用，start之后调用者不应再直接使用它。
+//
+// 使用示例：
+// mooon::sys::CDiskQueue spool;
+// spool.open("/data/kafka_spool");
+// mooon::net::CKafkaProducer producer;
+// producer.set_batching(5, 10000, "lz4", 100000);
+// producer.init(brokers, topic);
+// producer.set_spool(&spool);
+// mooon::net::CAsyncKafkaProducer async_producer(&producer, 64*1024*1024);
+// async_producer.start();
+// async_producer.produce(key, log);
+// async_producer.stop(10000); // 在producer和spool销毁之前
+class CAsyncKafkaProducer
+{
+public:
+    // producer须已init，由调用者销毁，须在stop之后
+    // memory_budget 内存中消息的总字节数上限（key和消息的字节数之和）
+    CAsyncKafkaProducer(CKafkaProducer* producer, size_t memory_budget);
+    ~CAsyncKafkaProducer();
+
+    // 启动后台线程，poll_interval_ms为没有新消息时调用timed_poll的间隔
+    // 出错抛出CSyscallException异常
+    void start(int poll_interval_ms=10);
+
+    // 停止后台线程，内存中的消息都交给CKafkaProducer后，最多flush_timeout_ms毫秒等待递送完成
+    void stop(int flush_timeout_ms=10000);
+
+    // 返回true表示消息已被接受（在内存中或已溢出到spool），返回false表示被丢弃
+    bool produce(const std::string& key, const std::string& log);
+
+    void get_stats(AsyncKafkaProducerStats* stats) const;
+
+private:
+    struct Message
+    {
+        std::string key;
+        std::string log;
+        uint64_t accepted_us;
+    };
+
+    CAsyncKafkaProducer(const CAsyncKafkaProducer&);
+    CAsyncKafkaProducer& operator =(const CAsyncKafkaProducer&);
+    void run();
+    void produce_messages(std::deque<Message>* messages);
+
+private:
+    CKafkaProducer* _producer;
+    const size_t _memory_budget;
+    int _poll_interval_ms;
+    mooon::sys::CThreadEngine* _thread;
+
+private:
+    mutable mooon::sys::CLock _lock;
+    mooon::sys::CEvent _event;
+    std::deque<Message> _messages;
+    size_t _buffered_bytes;   // 包括后台线程正在入队的
+    bool _spilling;           // 溢出开始后直到spool重放完
+    volatile bool _stop;
+    uint64_t _accepted_number;
+    uint64_t _spilled_number;
+    uint64_t _dropped_number;
+    uint64_t _max_buffered_bytes;
+    uint64_t _total_queue_latency_us;
+    uint64_t _max_queue_latency_us;
 };
 
 NET_NAMESPACE_END
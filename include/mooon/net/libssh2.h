@@ -65,9 +65,13 @@
 #ifndef MOOON_NET_LIBSSH2_H
 #define MOOON_NET_LIBSSH2_H
 #include "mooon/net/config.h"
+#include "mooon/sys/lock.h"
 #include "mooon/sys/syscall_exception.h"
+#include "mooon/utils/compressor.h"
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <vector>
 NET_NAMESPACE_BEGIN
 
 // 为非线程安全类
@@ -118,6 +122,33 @@ public:
     // num_bytes 远程命令吐出的字节数
     void remotely_execute(const std::string& command, std::ostream& out, int* exitcode, std::string* exitsignal, std::string* errmsg, int64_t* num_bytes);
 
+    // 一条命令的执行结果
+    struct ExecuteResult
+    {
+        std::string output;     // 命令的标准输出
+        int exitcode;           // 退出代码，命令未能执行时为-1
+        std::string exitsignal; // 接收到的信号
+        std::string errmsg;     // 出错信息
+
+        ExecuteResult()
+            : exitcode(-1)
+        {
+        }
+    };
+
+    // 在同一会话上以多个通道并发执行多条命令，每条命令一个通道，同时最多打开max_channels个通道，
+    // 执行期间会话临时切换为非阻塞方式，结束后恢复
+    // results 和commands一一对应，单条命令执行失败只记录在它的结果中
+    // 会话级的错误（如连接断开或超时）抛出异常，此后会话不再可用
+    void remotely_execute(const std::vector<std::string>& commands, std::vector<struct ExecuteResult>* results, int max_channels=4);
+
+    // 会话是否仍然可用（对端未关闭连接），用于复用会话前的检查
+    bool is_alive() const;
+
+    const std::string& get_ip() const { return _ip; }
+    uint16_t get_port() const { return _port; }
+    const std::string& get_username() const { return _username; }
+
     // 下载远端的文件到本地
     // remote_filepath 被下载的远端文件
     // num_bytes 远端文件的字节数
@@ -127,6 +158,64 @@ public:
     // num_bytes 本地文件的字节数
     void upload(const std::string& local_filepath, const std::string& remote_filepath, int64_t* num_bytes);
 
+    // 上传内存中的数据到远端，多台主机上传同一文件时本地文件只需读一次
+    // filemode 远端文件的权限，如0644
+    // mtime 最近一次修改时间
+    // atime 最近一次访问时间
+    void upload(const char* data, size_t size, const std::string& remote_filepath, int filemode, time_t mtime, time_t atime);
+
+    // 压缩后上传内存中的数据，远端以“压缩命令 -dc”（如gzip -dc）解压到临时文件，成功后再改名为remote_filepath，
+    // 要求远端有对应的命令，压缩方式只能是gzip、zstd或lz4，为compression_none时同不压缩的upload
+    // filemode 远端文件的权限，如0644
+    // num_bytes 实际发送的（压缩后的）字节数
+    void upload(const char* data, size_t size, const std::string& remote_filepath, int filemode, utils::compression_t compression, int64_t* num_bytes);
+
+    // 上传已压缩的数据，同上，用于同一文件上传到多台主机时只压缩一次
+    void upload_compressed(const char* compressed_data, size_t compressed_size, const std::string& remote_filepath, int filemode, utils::compression_t compression, int64_t* num_bytes);
+
+    // 一个SFTP传输的文件
+    struct SftpTransfer
+    {
+        std::string remote_filepath;
+        std::string local_filepath;
+        bool resume;           // 下载时是否续传：本地文件比远端的小时，从本地文件的大小处接着下载，只对下载有效
+        int64_t file_size;     // 文件的大小，下载时为打开远端文件后取得的，未知时为-1
+        int64_t offset;        // 开始传输的位置，续传时为本地已有的字节数，否则为0
+        int64_t num_bytes;     // 本次已传输的字节数，不含续传前已有的
+        uint32_t milliseconds; // 从打开到关闭文件的时长
+        std::string errmsg;    // 出错信息，为空表示成功
+
+        SftpTransfer()
+            : resume(false), file_size(-1), offset(0), num_bytes(0), milliseconds(0)
+        {
+        }
+
+        SftpTransfer(const std::string& remote_filepath_, const std::string& local_filepath_, bool resume_=false)
+            : remote_filepath(remote_filepath_), local_filepath(local_filepath_), resume(resume_),
+              file_size(-1), offset(0), num_bytes(0), milliseconds(0)
+        {
+        }
+    };
+
+    // SFTP传输的进度回调，每传输一块数据和每个文件结束时被调用，在调用sftp_download或sftp_upload的线程中
+    typedef void (*sftp_progress_t)(const struct SftpTransfer& transfer, bool finished, void* context);
+
+    // 以SFTP在同一会话上同时下载多个文件，同时最多打开max_files个，
+    // 每个文件每次读buffer_size字节，libssh2将其拆分为多个同时在途的读请求（流水线，同OpenSSH的sftp -R），
+    // 不必一个请求往返一次，收到的数据以pwrite直接写入本地文件，不经过流，
+    // 执行期间会话临时切换为非阻塞方式，结束后恢复
+    // 单个文件的失败（如远端文件不存在或本地文件写失败）只记录在它的errmsg中，
+    // 会话级的错误（如连接断开、超时或远端不支持SFTP）抛出异常，此后会话不再可用
+    // progress不为NULL时报告进度，context为传给它的参数
+    void sftp_download(std::vector<struct SftpTransfer>* transfers, int max_files=8, size_t buffer_size=1024*1024, sftp_progress_t progress=NULL, void* context=NULL);
+
+    // 以SFTP上传，同sftp_download，本地文件以pread读取，远端文件的权限同本地文件
+    void sftp_upload(std::vector<struct SftpTransfer>* transfers, int max_files=8, size_t buffer_size=1024*1024, sftp_progress_t progress=NULL, void* context=NULL);
+
+    // 远程执行命令，并以data作为命令的标准输入，写完后关闭标准输入，
+    // 可用于配合解压命令上传压缩后的数据，如：gzip -dc > /tmp/x.txt
+    void remotely_execute(const std::string& command, const char* data, size_t size, std::ostream& out, int* exitcode, std::string* exitsignal, std::string* errmsg, int64_t* num_bytes);
+
 private:
     int get_session_errcode() const;
     std::string get_session_errmsg() const;
@@ -145,6 +234,7 @@ private:
     int close_ssh_channel(void* channel, std::string* exitsignal, std::string* errmsg);
     int64_t read_channel(void* channel, std::ostream& out, const struct stat* fileinfo);
     void write_channel(void* channel, const char *buffer, size_t buffer_size);
+    void sftp_transfer(std::vector<struct SftpTransfer>* transfers, bool is_download, int max_files, size_t buffer_size, sftp_progress_t progress, void* context);
 
 private:
     int _socket_fd;
@@ -155,5 +245,61 @@ private:
     uint32_t _timeout_seconds;
 };
 
+// 线程安全的会话池，按“ip:port:username”缓存已认证的会话，
+// 复用时省去TCP连接、ssh2握手和认证，适用于对同一批主机反复执行命令或上传文件
+//
+// 使用示例：
+// net::CLibssh2Pool pool;
+// net::CLibssh2* libssh2 = pool.get(ip, port, username, password);
+// try
+// {
+//     libssh2->upload(local_filepath, remote_filepath, &num_bytes);
+//     pool.put(libssh2);
+// }
+// catch (...)
+// {
+//     pool.put(libssh2, true);
+//     throw;
+// }
+class CLibssh2Pool
+{
+public:
+    // idle_seconds 会话空闲超过该时长不再复用
+    // timeout_seconds 新建会话时的超时时长，单位为秒
+    CLibssh2Pool(uint32_t idle_seconds=300, uint32_t timeout_seconds=2);
+    ~CLibssh2Pool();
+
+    // 取得一个会话，没有可复用的空闲会话时新建，新建失败抛出异常
+    // 只复用密码相同的会话，以免持有会话的进程替不知道密码的调用者执行命令
+    // reused 不为NULL时，返回会话是否为复用的
+    CLibssh2* get(const std::string& ip, uint16_t port, const std::string& username, const std::string& password, bool* reused=NULL);
+
+    // 归还由get取得的会话，broken为true表示会话已不可用（如使用时抛了异常），将被销毁
+    void put(CLibssh2* libssh2, bool broken=false);
+
+    // 销毁空闲超时的会话
+    void clear_idle();
+
+    size_t get_idle_number() const;
+
+private:
+    struct IdleSession
+    {
+        CLibssh2* libssh2;
+        std::string password;
+        time_t idle_time; // 开始空闲的时间
+    };
+
+private:
+    static std::string get_key(const std::string& ip, uint16_t port, const std::string& username);
+
+private:
+    uint32_t _idle_seconds;
+    uint32_t _timeout_seconds;
+    mutable sys::CLock _lock;
+    std::multimap<std::string, struct IdleSession> _idle_sessions;
+    std::map<CLibssh2*, std::string> _busy_sessions; // 使用中的会话及其密码
+};
+
 NET_NAMESPACE_END
 #endif // MOOON_NET_LIBSSH2_H
@@ -19,10 +19,26 @@
 #ifndef MOOON_NET_LISTEN_MANAGER_H
 #define MOOON_NET_LISTEN_MANAGER_H
 #include "mooon/net/ip_address.h"
+#include "mooon/sys/utils.h"
 NET_NAMESPACE_BEGIN
 
+/***
+  * 分片监听时，连接在各分片间的引导方式
+  */
+typedef enum
+{
+    steering_none         = 0, /** 由内核按四元组哈希分配 */
+    steering_incoming_cpu = 1, /** 第k个分片设置SO_INCOMING_CPU为k%CPU个数 */
+    steering_cpu_bpf      = 2  /** 挂载BPF程序，按处理连接的CPU选择分片 */
+}shard_steering_t;
+
 /***
   * 监听管理者模板类
+  *
+  * 支持分片模式：对每个IP端口对创建shard_number个SO_REUSEPORT监听者，
+  * 通常一个分片对应一个Reactor线程，使得accept不再被串行化到单个套接字和线程上，
+  * 监听者数组按“IP端口对序号*shard_number+分片序号”排列。
+  * 分片模式要求ListenClass::listen的参数和CListener::listen相同。
   */
 template <class ListenClass>
 class CListenManager
@@ -30,6 +46,7 @@ class CListenManager
 public:
     CListenManager()
         :_listener_count(0)
+        ,_shard_number(1)
         ,_listener_array(NULL)
     {
     }
@@ -53,18 +70,28 @@ public:
 
     /***
       * 启动在所有IP和端口对上的监听
+      * @shard_number: 每个IP端口对的SO_REUSEPORT监听者个数，为1时不使用SO_REUSEPORT
+      * @steering: 分片模式下的连接引导方式
       * @exception: 如果出错，则抛出CSyscallException异常
       */
-    void create(bool nonblock=true)
+    void create(bool nonblock=true, uint16_t shard_number=1, shard_steering_t steering=steering_none)
     {
-        _listener_array = new ListenClass[_ip_port_array.size()];
+        _shard_number = (0 == shard_number)? 1: shard_number;
+        _listener_array = new ListenClass[_ip_port_array.size() * _shard_number];
 
         for (ip_port_pair_array_t::size_type i=0; i<_ip_port_array.size(); ++i)
         {
             try
-            {                
-                _listener_array[i].listen(_ip_port_array[i].first, _ip_port_array[i].second, nonblock);
-                ++_listener_count;
+            {
+                if (1 == _shard_number)
+                {
+                    _listener_array[i].listen(_ip_port_array[i].first, _ip_port_array[i].second, nonblock);
+                    ++_listener_count;
+                }
+                else
+                {
+                    create_shards(i, nonblock, steering);
+                }
             }
             catch (...)
             {
@@ -94,11 +121,46 @@ public:
     /** 得到监听者个数 */
     uint16_t get_listener_count() const { return _listener_count; }
 
+    /** 得到每个IP端口对的分片个数 */
+    uint16_t get_shard_number() const { return _shard_number; }
+
     /** 得到指向监听者对象数组指针 */
     ListenClass* get_listener_array() const { return _listener_array; }
-    
+
+    /***
+      * 得到指定IP端口对的指定分片，
+      * 通常第k个Reactor线程监控所有IP端口对的第k个分片
+      */
+    ListenClass* get_listener(uint16_t endpoint_index, uint16_t shard_index) const
+    {
+        const uint16_t index = endpoint_index * _shard_number + shard_index;
+        if ((shard_index >= _shard_number) || (index >= _listener_count))
+            return NULL;
+        return &_listener_array[index];
+    }
+
+private:
+    void create_shards(ip_port_pair_array_t::size_type endpoint_index, bool nonblock, shard_steering_t steering)
+    {
+        const uint16_t cpu_number = sys::CUtils::get_cpu_number();
+        ListenClass* shards = &_listener_array[endpoint_index * _shard_number];
+
+        // 组内序号即为listen的先后顺序，BPF程序依赖这一点
+        for (uint16_t k=0; k<_shard_number; ++k)
+        {
+            shards[k].listen(_ip_port_array[endpoint_index].first, _ip_port_array[endpoint_index].second, nonblock, false, true);
+            ++_listener_count;
+
+            if ((steering_incoming_cpu == steering) && (cpu_number > 0))
+                shards[k].set_incoming_cpu(k % cpu_number);
+        }
+        if (steering_cpu_bpf == steering)
+            shards[0].attach_reuseport_cpu_steering(_shard_number);
+    }
+
 private:
     uint16_t _listener_count;
+    uint16_t _shard_number;
     ListenClass* _listener_array;
     ip_port_pair_array_t _ip_port_array;
 };
@@ -22,6 +22,29 @@
 #include "mooon/net/epollable.h"
 NET_NAMESPACE_BEGIN
 
+/** accept_batch接受的一个连接，peer_port同accept为网络字节序 */
+typedef struct accepted_t
+{
+    int fd;
+    uint16_t peer_port;
+    ip_address_t peer_ip;
+}accepted_t;
+
+/***
+  * 系统范围的监听统计（/proc/net/netstat的TcpExt），
+  * 持续增长的listen_overflows说明accept不及时或backlog太小，
+  * syncookies_sent增长说明SYN队列已满（可能遭受SYN flood）
+  */
+typedef struct listen_stats_t
+{
+    uint64_t listen_overflows;  /** 因accept队列满而丢弃的连接数 */
+    uint64_t listen_drops;      /** 监听者丢弃的SYN数，包括listen_overflows */
+    uint64_t syncookies_sent;
+    uint64_t syncookies_recv;
+    uint64_t syncookies_failed;
+    int syncookies;             /** net.ipv4.tcp_syncookies的值，读取失败时为-1 */
+}listen_stats_t;
+
 /***
   * TCP服务端监听者类
   * 用于启动在某端口上的监听和接受连接请求
@@ -32,6 +55,13 @@ public:
     /** 构造一个TCP监控者 */
     CListener();
 
+    /***
+      * 设置listen的backlog（accept队列的大小），应当在listen之前调用，默认为10000，
+      * 实际的值不超过net.core.somaxconn
+      */
+    void set_backlog(int backlog) { _backlog = backlog; }
+    int get_backlog() const { return _backlog; }
+
     /** 是否为IPV6监听者 */
     bool is_ipv6() const throw () { return _ip.is_ipv6(); }
     
@@ -54,6 +84,60 @@ public:
       * @exception: 如果发生错误，则抛出CSyscallException异常
       */
     int accept(ip_address_t& peer_ip, uint16_t& peer_port);
+
+    /***
+      * 批量接受连接，用于非阻塞监听者在每次可读时取完accept队列，
+      * 以accept4一次设置好FD_CLOEXEC和非阻塞，不再需要逐个调用fcntl
+      * @accepted_array: 存放接受的连接，至少有max_number个元素
+      * @nonblock: 接受的连接是否为非阻塞的
+      * @return: 接受的连接个数，为0表示队列已空，
+      *          已接受了部分连接时遇到错误（如EMFILE）也直接返回，错误留给下一次调用
+      * @exception: 如果一个也未接受就发生错误，则抛出CSyscallException异常
+      */
+    int accept_batch(accepted_t* accepted_array, int max_number, bool nonblock=true);
+
+    /***
+      * 设置TCP_DEFER_ACCEPT，连接有数据到达后才进入accept队列，
+      * 使accept后第一次读即可读到请求，应当在listen之后调用
+      * @seconds: 等待数据的最长秒数，超过后由内核决定丢弃或仍交给accept
+      * @exception: 如果发生错误，则抛出CSyscallException异常
+      */
+    void set_defer_accept(uint32_t seconds);
+
+    /***
+      * 得到accept队列的当前长度和最大长度（即生效的backlog）
+      * @return: 如果出错，则返回false
+      */
+    bool get_queue_info(uint32_t* queue_length, uint32_t* max_length) const;
+
+    /***
+      * 得到系统范围的监听统计，可定期采样其增量用于诊断
+      * @return: 如果读取/proc/net/netstat失败，则返回false
+      */
+    static bool get_listen_stats(listen_stats_t* stats);
+
+    /***
+      * 设置SO_INCOMING_CPU，让内核优先将在指定CPU上收到的连接交给本监听者，
+      * 只对设置了reuse_port的监听者有意义，应当在listen之后调用
+      * @exception: 如果发生错误，则抛出CSyscallException异常
+      */
+    void set_incoming_cpu(int cpu);
+
+    /***
+      * 开启TCP Fast Open，接受随SYN一起到达的数据，应当在listen之后调用，
+      * 还需net.ipv4.tcp_fastopen包含服务端的标志（2）
+      * @queue_length: 尚未完成握手的Fast Open连接的最大个数
+      * @exception: 如果发生错误，则抛出CSyscallException异常
+      */
+    void enable_fast_open(int queue_length=1024);
+
+    /***
+      * 为SO_REUSEPORT组挂载BPF程序，按处理连接的CPU选择组内第cpu%group_size个监听者，
+      * 只需对组内任意一个监听者调用一次，组内监听者的序号即为listen的先后顺序
+      * @group_size: 组内监听者个数
+      * @exception: 如果发生错误，则抛出CSyscallException异常
+      */
+    void attach_reuseport_cpu_steering(uint16_t group_size);
     
     /** 得到监听的IP地址 */
     const ip_address_t& get_listen_ip() const throw () { return _ip; }
@@ -63,6 +147,7 @@ public:
 
 private:    
     uint16_t _port;
+    int _backlog;
     ip_address_t _ip;
 };
 
@@ -0,0 +1,95 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_LOG_SINK_H
+#define MOOON_NET_LOG_SINK_H
+#include "mooon/net/kafka_producer.h"
+#include "mooon/net/udp_socket.h"
+#include "mooon/sys/log_sink.h"
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 以UDP发送日志，多行日志拼入一个数据报（不超过message_size字节），
+  * 一批日志组成的多个数据报以sendmmsg一次系统调用发出。
+  * 一行超过message_size的日志被截断。UDP不保证送达，发送出错（如网络不可达）时由CLogger写本地文件。
+  *
+  * 使用示例：
+  * logger->set_sink(new mooon::net::CUdpLogSink("10.0.0.1", 5140));
+  */
+class CUdpLogSink: public sys::ILogSink
+{
+public:
+    /***
+      * @ip: 接收端的IPv4地址
+      * @port: 接收端端口
+      * @message_size: 一个数据报最多的字节数，默认不超过以太网MTU，避免IP分片
+      * @exception: ip无效时抛出utils::CException异常，创建socket失败时抛出sys::CSyscallException异常
+      */
+    CUdpLogSink(const std::string& ip, uint16_t port, uint32_t message_size=1472);
+
+    virtual int send(const struct iovec* log_lines, int number);
+
+private:
+    CUdpSocket _socket;
+    CUdpMessageArena _arena;
+    struct sockaddr_in _to_addr;
+    std::string _packet;          // 正在拼的数据报
+    std::vector<int> _last_lines; // 每个数据报中最后一行的下标
+};
+
+#if MOOON_HAVE_LIBRDKAFKA==1
+/***
+  * 以CKafkaProducer发送日志，一批日志以produce_batch一次入队，
+  * producer由调用者init，之后只能由日志线程使用（CKafkaProducer非线程安全），
+  * CKafkaLogSink不负责销毁producer，且producer须在CLogger销毁之后才销毁。
+  * 入队失败（如本地队列满）的日志由CLogger写本地文件。
+  */
+class CKafkaLogSink: public sys::ILogSink
+{
+public:
+    /***
+      * @producer: 已init的生产者
+      * @key: 消息的键，决定分区，为空时由分区器决定
+      */
+    CKafkaLogSink(CKafkaProducer* producer, const std::string& key=std::string())
+        : _producer(producer), _key(key)
+    {
+    }
+
+    virtual int send(const struct iovec* log_lines, int number)
+    {
+        _logs.resize(number);
+        for (int i=0; i<number; ++i)
+            _logs[i].assign(static_cast<const char*>(log_lines[i].iov_base), log_lines[i].iov_len);
+
+        // produce_batch中入队失败的不影响其它的，只有全部成功才算发出，否则整批写本地文件
+        const int produced = _producer->produce_batch(_key, _logs);
+        _producer->timed_poll(0);
+        return (produced == number)? number: 0;
+    }
+
+private:
+    CKafkaProducer* _producer;
+    std::string _key;
+    std::vector<std::string> _logs;
+};
+#endif // MOOON_HAVE_LIBRDKAFKA
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_LOG_SINK_H
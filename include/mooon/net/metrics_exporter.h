@@ -0,0 +1,138 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_METRICS_EXPORTER_H
+#define MOOON_NET_METRICS_EXPORTER_H
+#include "mooon/net/epoller.h"
+#include "mooon/net/listener.h"
+#include "mooon/net/udp_socket.h"
+#include "mooon/sys/info.h"
+#include "mooon/sys/thread_engine.h"
+#include "mooon/utils/args_parser.h"
+#include <set>
+#include <string>
+
+// 以HTTP提供度量的监听IP和端口（端口为0时表示不提供）
+STRING_ARG_DECLARE(metrics_ip);
+INTEGER_ARG_DECLARE(uint16_t, metrics_port);
+
+// UDP推送度量的目标，格式为IP:端口（值为空时表示不推送），以及推送间隔秒数
+STRING_ARG_DECLARE(metrics_push);
+INTEGER_ARG_DECLARE(int, metrics_push_interval);
+
+// 采样本机和当前进程资源使用率的间隔毫秒数（为0时表示不采样）
+INTEGER_ARG_DECLARE(int, metrics_sample_interval);
+
+NET_NAMESPACE_BEGIN
+
+class CMetricsConnection;
+
+/***
+  * 度量导出器，在独立的线程中以CEpoller和CListener提供CMetricsRegistry中的度量：
+  * GET /metrics       Prometheus文本格式
+  * GET /metrics.json  JSON格式
+  * 每个连接只应答一个请求（HTTP/1.0，应答后关闭连接）。
+  *
+  * 也可定时以UDP推送Prometheus文本格式，按行打包，每个数据报不超过1400字节，数据报之间没有顺序关系。
+  * 导出的是累计的快照，如果同时运行了CMetricsRegistry::start，直方图为其最近一个周期的。
+  * 启用采样时，导出线程定时以CInfoSampler采样CPU、上下文切换和网卡流量等速率，并设置为度量。
+  *
+  * main_template在指定了命令行参数metrics_port或metrics_push时自动启动导出器。
+  */
+class CMetricsExporter
+{
+public:
+    CMetricsExporter();
+    ~CMetricsExporter();
+
+    /***
+      * 启用HTTP，应在start之前调用
+      * @port: 为0时由系统分配，start后可由get_http_port得到
+      */
+    void enable_http(const std::string& ip, uint16_t port);
+
+    /***
+      * 启用UDP推送，应在start之前调用
+      * @ip: 目标IP
+      * @port: 目标端口
+      * @interval_seconds: 推送间隔秒数
+      */
+    void enable_push(const std::string& ip, uint16_t port, uint32_t interval_seconds);
+
+    /***
+      * 启用资源采样，应在start之前调用，具体请参考CInfoSampler::publish_metrics
+      * @interval_milliseconds: 采样间隔毫秒数
+      */
+    void enable_sampling(uint32_t interval_milliseconds);
+
+    /***
+      * 启动导出线程
+      * @exception: 出错抛出CSyscallException或CException异常
+      */
+    void start();
+
+    /** 停止导出线程，并关闭所有连接 */
+    void stop();
+
+    /** 得到实际监听的端口 */
+    uint16_t get_http_port() const { return _http_port; }
+
+    /** 得到已应答的HTTP请求数 */
+    uint64_t get_request_number() const { return __atomic_load_n(&_request_number, __ATOMIC_RELAXED); }
+
+    /** 得到已推送的次数 */
+    uint64_t get_push_number() const { return __atomic_load_n(&_push_number, __ATOMIC_RELAXED); }
+
+    /** 得到已采样的次数 */
+    uint64_t get_sample_number() const { return __atomic_load_n(&_sample_number, __ATOMIC_RELAXED); }
+
+private:
+    friend class CMetricsConnection;
+    void run();
+    void accept_connections();
+    void close_connection(CMetricsConnection* connection);
+    void close_idle_connections();
+    void push();
+    void sample();
+    std::string get_response(const std::string& path);
+
+private:
+    bool _http_enabled;
+    std::string _http_ip;
+    uint16_t _http_port;
+    bool _push_enabled;
+    std::string _push_ip;
+    uint16_t _push_port;
+    uint32_t _push_interval_seconds;
+    uint32_t _sample_interval_milliseconds; // 为0表示不采样
+    sys::CInfoSampler _sampler;
+
+private:
+    CEpoller _epoller;
+    CListener _listener;
+    CUdpSocket* _udp_socket;
+    std::set<CMetricsConnection*> _connections;
+    sys::CThreadEngine* _engine;
+    volatile bool _stop;
+    uint64_t _request_number;
+    uint64_t _push_number;
+    uint64_t _sample_number;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_METRICS_EXPORTER_H
@@ -0,0 +1,203 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_MYSQL_ASYNC_H
+#define MOOON_NET_MYSQL_ASYNC_H
+#include "mooon/net/event_loop.h"
+#include "mooon/sys/simple_db.h"
+#include <deque>
+
+#if MOOON_HAVE_MYSQL==1
+NET_NAMESPACE_BEGIN
+
+/** 异步MySQL连接的参数 */
+struct mysql_config_t
+{
+    std::string db_ip;
+    uint16_t db_port;
+    std::string db_user;
+    std::string db_password;
+    std::string db_name;
+    std::string charset;
+    int connect_timeout_seconds;
+    int read_timeout_seconds;
+    int write_timeout_seconds;
+
+    mysql_config_t()
+        : db_port(3306), charset("utf8"),
+          connect_timeout_seconds(10), read_timeout_seconds(10), write_timeout_seconds(10)
+    {
+    }
+};
+
+/** 异步查询的结果 */
+struct mysql_result_t
+{
+    int errcode;               /** 0表示成功，否则为mysql_errno */
+    std::string errmsg;
+    bool is_select;            /** 为true时rows有效，否则affected_rows和insert_id有效 */
+    sys::DBTable rows;          /** NULL字段为空字符串 */
+    uint64_t affected_rows;
+    uint64_t insert_id;
+    uint64_t latency_nanoseconds; /** 从query到得到结果的耗时，包括排队 */
+
+    mysql_result_t()
+        : errcode(0), is_select(false), affected_rows(0), insert_id(0), latency_nanoseconds(0)
+    {
+    }
+};
+
+class CAsyncMySQLConnection;
+
+/** 异步查询结果的回调接口 */
+class IMySQLResultHandler
+{
+public:
+    virtual ~IMySQLResultHandler() {}
+
+    /***
+      * 在连接所在的事件循环线程中被调用，之后handler不再被该查询使用
+      * @result: 回调返回后失效，需要保留的行应swap出去
+      */
+    virtual void on_result(CAsyncMySQLConnection* connection, mysql_result_t* result) = 0;
+};
+
+/***
+  * 由事件循环驱动的非阻塞MySQL连接，
+  * 使用MariaDB Connector/C的非阻塞接口（mysql_real_connect_start/cont、mysql_real_query_start/cont等），
+  * 等待服务端时不占用线程，一个循环线程可以同时驱动许多连接，每个连接上的查询按序执行。
+  *
+  * 1) 连接在第一次查询时建立，断开后在下一次查询时重新建立，
+  *    因断开而失败的查询不自动重试（可能已在服务端执行），由回调方决定
+  * 2) 连接超时和读写超时由客户端库给出，以事件循环的定时器实现
+  * 3) 需在创建线程之前调用sys::CMySQLConnection::library_init
+  *
+  * 连接创建时引用计数为1（创建者的），加入事件循环时再加一，
+  * 不再使用时调用release，它在循环线程中使未完成的查询以CR_CONNECTION_ERROR失败，
+  * 关闭连接并减去创建者的引用计数。
+  */
+class CAsyncMySQLConnection: public CEpollable, public ITimerHandler
+{
+public:
+    CAsyncMySQLConnection(CEventLoop* event_loop, const mysql_config_t& config);
+
+    /***
+      * 异步执行一条SQL，可在任意线程中调用，结果在循环线程中回调handler
+      * @sql: 由调用者转义，可使用sys::CMySQLConnection::escape_string
+      * @handler: 为NULL时不回调，用于不关心结果的更新
+      */
+    void query(const std::string& sql, IMySQLResultHandler* handler);
+
+    /** 关闭连接并释放创建者的引用，可在任意线程中调用，之后不能再使用该对象 */
+    void release();
+
+    CEventLoop* get_event_loop() const { return _event_loop; }
+
+    /** 已提交但还未回调的查询个数，包括正在执行的 */
+    uint32_t get_pending_number() const { return __atomic_load_n(&_pending_number, __ATOMIC_RELAXED); }
+
+    /** 是否已和服务端建立连接，只在循环线程中调用时准确 */
+    bool is_established() const { return state_idle == _state || state_querying == _state || state_storing == _state; }
+
+private:
+    virtual ~CAsyncMySQLConnection();
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+    virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id);
+
+private:
+    class CQueryTask;
+    class CReleaseTask;
+    friend class CQueryTask;
+    friend class CReleaseTask;
+
+    typedef enum
+    {
+        state_closed     = 0,
+        state_connecting = 1,
+        state_idle       = 2,
+        state_querying   = 3,
+        state_storing    = 4
+    }state_t;
+
+    struct Query
+    {
+        std::string sql;
+        IMySQLResultHandler* handler;
+        uint64_t start_time;
+    };
+
+    void enqueue(const Query& query);
+    void do_release();
+    void start_connect();
+    void start_query();
+    void resume(int status);
+    void wait_for(int status);
+    void finish_connect(bool success);
+    void finish_query(void* result_set);
+    void fail_query(int errcode, const std::string& errmsg);
+    void fail_all(int errcode, const std::string& errmsg);
+    void disconnect();
+
+private:
+    CEventLoop* _event_loop;
+    const mysql_config_t _config;
+    void* _mysql_handle;
+    state_t _state;
+    bool _registered;          /** fd是否已加入事件循环 */
+    bool _released;
+    uint64_t _timer_id;        /** 等待客户端库超时的定时器，为0表示没有 */
+    void* _connect_result;     /** mysql_real_connect_cont的返回值 */
+    int _query_result;         /** mysql_real_query_cont的返回值 */
+    void* _store_result;       /** mysql_store_result_cont的返回值 */
+    std::deque<Query> _queries;
+    uint32_t _pending_number;
+};
+
+/***
+  * 分布在CReactorPool各循环上的一组异步连接，查询按在途查询数最少分配，
+  * 几个循环线程即可保持数百个查询同时在途。
+  *
+  * 使用示例：
+  * mooon::net::CAsyncMySQLPool mysql_pool(&reactor_pool, 16, config);
+  * mysql_pool.query("SELECT id,name FROM test", &handler);
+  */
+class CAsyncMySQLPool
+{
+public:
+    /***
+      * @connections_per_loop: 每个循环上的连接个数
+      */
+    CAsyncMySQLPool(CReactorPool* reactor_pool, uint16_t connections_per_loop, const mysql_config_t& config);
+    ~CAsyncMySQLPool();
+
+    /** 可在任意线程中调用，结果在所选连接的循环线程中回调 */
+    void query(const std::string& sql, IMySQLResultHandler* handler);
+
+    uint32_t get_connection_number() const { return static_cast<uint32_t>(_connections.size()); }
+
+    /** 所有连接上已提交但还未回调的查询个数 */
+    uint32_t get_pending_number() const;
+
+private:
+    std::vector<CAsyncMySQLConnection*> _connections;
+    uint32_t _next;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_HAVE_MYSQL
+#endif // MOOON_NET_MYSQL_ASYNC_H
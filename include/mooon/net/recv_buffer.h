@@ -0,0 +1,120 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_RECV_BUFFER_H
+#define MOOON_NET_RECV_BUFFER_H
+#include "mooon/net/config.h"
+#include "mooon/sys/slab_mem_pool.h"
+#include <sys/types.h>
+#include <sys/uio.h>
+NET_NAMESPACE_BEGIN
+
+// 一次接收时栈上落地区的大小，超出接收缓冲区空闲空间的数据先收到这里
+#define RECV_BUFFER_EXTRA_SIZE 65536
+
+/***
+  * 自适应大小的连接接收缓冲区，空闲的连接不占用内存：
+  * 1) 可读时才分配（EPOLLIN-then-allocate），以readv同时收到缓冲区的空闲空间和栈上的落地区，
+  *    没有缓冲区时直接收到落地区，再按收到的字节数分配合适大小的缓冲区
+  * 2) 大小按2的幂的尺寸级别增长，可从CSlabMemPool分配（同一线程的多个连接共享），为NULL时从堆上分配
+  * 3) drain后数据为空时释放缓冲区，剩余的数据远小于容量时缩小到合适的级别
+  * 这样大量长期空闲的长连接（如long-poll）几乎不占用接收缓冲区，而大消息的连接仍然可以一次收大块。
+  *
+  * 非线程安全，使用CSlabMemPool时池须属于同一线程。
+  * 度量recv_buffer.bytes为所有接收缓冲区占用的字节数。
+  *
+  * 使用示例：
+  * ssize_t bytes = recv_buffer.read_fd(fd, recv_buffer.get_read_space());
+  * size_t consumed = parse(recv_buffer.data(), recv_buffer.size());
+  * recv_buffer.drain(consumed); // 全部处理完时释放缓冲区
+  */
+class CRecvBuffer
+{
+public:
+    /***
+      * @min_size: 最小的缓冲区大小，即第一次分配的大小
+      * @pool: 尺寸级别内存池，所有权不转移，须比缓冲区的生命周期长，为NULL时从堆上分配
+      */
+    CRecvBuffer(size_t min_size=4096, sys::CSlabMemPool* pool=NULL);
+    ~CRecvBuffer();
+
+    /** 未处理的数据 */
+    char* data() { return _data + _begin; }
+    const char* data() const { return _data + _begin; }
+    size_t size() const { return _end - _begin; }
+    bool empty() const { return _begin == _end; }
+
+    /** 得到当前缓冲区的容量，为0表示未分配 */
+    size_t capacity() const { return _capacity; }
+
+    /** 得到一次接收最多可收的字节数，即缓冲区尾部的空闲空间加上落地区的大小 */
+    size_t get_read_space() const { return (_capacity - _end) + RECV_BUFFER_EXTRA_SIZE; }
+
+    /***
+      * 以readv从fd接收最多space个字节，追加到尾部
+      * @space: 不能超过get_read_space()
+      * @return: 同readv，收到的字节数，对端关闭为0，出错（包括非阻塞连接无数据）为-1并设置errno
+      */
+    ssize_t read_fd(int fd, size_t space);
+
+    /***
+      * 同read_fd，但以Connector的readv接收，Connector如CTcpWaiter、CDataChannel
+      * @return: 同Connector::readv
+      * @exception: 网络错误时由connector抛出CSyscallException异常
+      */
+    template <class Connector>
+    ssize_t read_from(Connector* connector)
+    {
+        char extra[RECV_BUFFER_EXTRA_SIZE];
+        struct iovec iov[2];
+        const int iovcnt = prepare_read(iov, extra, get_read_space());
+        const ssize_t bytes = connector->readv(&iov[2-iovcnt], iovcnt);
+        if (bytes > 0)
+            commit_read(static_cast<size_t>(bytes), extra);
+        return bytes;
+    }
+
+    /** 复制数据追加到尾部，空间不够时增长到合适的级别 */
+    void append(const char* data, size_t size);
+
+    /** 丢弃头部的size个字节（已处理），为空时释放缓冲区，超过时全部丢弃 */
+    void drain(size_t size);
+
+    /** 丢弃所有数据并释放缓冲区 */
+    void clear();
+
+private:
+    CRecvBuffer(const CRecvBuffer&);
+    CRecvBuffer& operator =(const CRecvBuffer&);
+
+    int prepare_read(struct iovec* iov, char* extra, size_t space) const;
+    void commit_read(size_t bytes, const char* extra);
+    size_t get_class_size(size_t size) const;
+    void reallocate(size_t capacity);
+
+private:
+    sys::CSlabMemPool* _pool;
+    size_t _min_size;
+    char* _data;
+    size_t _capacity;
+    size_t _begin;  /** 未处理数据的开始位置 */
+    size_t _end;    /** 已收到数据的结束位置 */
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_RECV_BUFFER_H
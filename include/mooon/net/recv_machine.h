@@ -19,6 +19,7 @@
 #ifndef MOOON_NET_RECV_MACHINE_H
 #define MOOON_NET_RECV_MACHINE_H
 #include <mooon/net/config.h>
+#include <mooon/net/io_buffer.h>
 NET_NAMESPACE_BEGIN
 
 /***
@@ -93,6 +94,10 @@ public:
     // buffer还包含第二个包的部分时，也是返回utils::handle_continue
     utils::handle_result_t work(const char* buffer, size_t buffer_size);
 
+    // 依次以buffer的各片段调用work，不复制，返回值同work，
+    // buffer不被修改，调用者处理完后可drain
+    utils::handle_result_t work(const CIoBuffer& buffer);
+
     // 复位状态，再次以包头开始
     void reset();
 
@@ -150,6 +155,26 @@ utils::handle_result_t CRecvMachine<MessageHeaderType, ProcessorManager>::work(
     return hr;
 }
 
+template <typename MessageHeaderType, class ProcessorManager>
+utils::handle_result_t CRecvMachine<MessageHeaderType, ProcessorManager>::work(const CIoBuffer& buffer)
+{
+    utils::handle_result_t hr = utils::handle_finish;
+
+    for (size_t i=0; i<buffer.get_slice_number(); ++i)
+    {
+        size_t slice_size;
+        const char* slice = buffer.get_slice(i, &slice_size);
+        if (0 == slice_size)
+            continue;
+
+        hr = work(slice, slice_size);
+        if (utils::handle_error == hr)
+            break;
+    }
+
+    return hr;
+}
+
 template <typename MessageHeaderType, class ProcessorManager>
 void CRecvMachine<MessageHeaderType, ProcessorManager>::set_next_state(
     recv_state_t next_state)
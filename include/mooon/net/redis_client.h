@@ -0,0 +1,256 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_REDIS_CLIENT_H
+#define MOOON_NET_REDIS_CLIENT_H
+#include "mooon/net/resp_parser.h"
+#include "mooon/net/tcp_client_pool.h"
+#include "mooon/sys/concurrency_limiter.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/hedge.h"
+#include "mooon/sys/lock.h"
+#include <map>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+// 集群的槽数
+#define REDIS_SLOT_NUMBER 16384
+
+// 一个命令最多跟随MOVED和ASK重定向的次数
+#define REDIS_MAX_REDIRECTIONS 5
+
+class CRedisConnection;
+class CHedgedRedisRequest;
+struct RedisRequest;
+
+/** 异步命令的应答回调 */
+class IRedisCallback
+{
+public:
+    virtual ~IRedisCallback() {}
+
+    /***
+      * 在事件循环线程中被调用，不要在其中阻塞
+      * @reply: 应答，连接失败、断开或超时时为reply_error类型，str以ERR开头
+      */
+    virtual void on_reply(const redis_reply_t& reply) = 0;
+};
+
+/***
+  * 非阻塞的Redis客户端，支持RESP2和RESP3，单机和集群。
+  * 所有收发都在一个事件循环线程中进行，不需要一个连接一个线程：
+  * 任意线程提交的命令先放入队列，由一个投递任务一次取出，
+  * 同一节点的命令追加到该节点连接的发送缓冲区一起发送（自动流水线），
+  * 应答按先进先出的顺序和命令对应。
+  *
+  * 连接从CTcpClientPool借用，在事件循环线程中借用不等待，没有空闲连接时
+  * 由连接池在后台建立，客户端定时重试，超过命令超时仍未借到时命令失败，
+  * 连接出错时归还为broken，在途的命令全部失败。
+  *
+  * 集群模式下用CLUSTER SLOTS建立槽到节点的映射，按命令的键（见get_command_key）路由，
+  * 收到MOVED时更新该槽并重发，同时刷新整个映射，收到ASK时向目标节点先发ASKING再重发，
+  * 重定向次数超过REDIS_MAX_REDIRECTIONS时将错误应答交给调用者。
+  */
+class CRedisClient: public ITimerHandler
+{
+    friend class CRedisConnection;
+    friend class CRedisStartTask;
+    friend class CRedisDrainTask;
+    friend class CRedisStopTask;
+
+public:
+    /***
+      * @event_loop: 收发所在的事件循环，须已启动
+      * @client_pool: 建立连接的连接池，可以和其它客户端共享
+      */
+    CRedisClient(CEventLoop* event_loop, CTcpClientPool* client_pool);
+    ~CRedisClient();
+
+    /** 是否为集群模式，须在create之前设置 */
+    void set_cluster(bool cluster) { _cluster = cluster; }
+
+    /** 是否用HELLO 3切换到RESP3，须在create之前设置 */
+    void set_resp3(bool resp3) { _resp3 = resp3; }
+
+    /** 设置命令超时毫秒数，包括借用连接的时间，默认为5000 */
+    void set_timeout_milliseconds(uint32_t milliseconds) { _timeout = milliseconds; }
+
+    /***
+      * 设置并发限制，所有权不转移，须在create之前设置，默认没有限制：
+      * 在途命令数达到限制时async_command在调用者线程中立即以错误应答回调，不进入队列，
+      * 超时和BUSY、LOADING、TRYAGAIN、CLUSTERDOWN应答作为过载的信号
+      */
+    void set_concurrency_limiter(sys::CConcurrencyLimiter* limiter) { _limiter = limiter; }
+
+    /***
+      * 增加节点，单机模式只用第一个，集群模式为用来取槽映射的种子节点，
+      * 须在create之前调用
+      */
+    void add_node(const ip_node_t& ip_node);
+
+    /** 启动，不能在事件循环线程中调用 */
+    void create();
+
+    /***
+      * 停止，未完成的命令收到错误应答，借用的连接被归还，
+      * 不能在事件循环线程中调用，事件循环须仍在运行
+      */
+    void destroy();
+
+    /***
+      * 异步执行命令，可被任意线程调用
+      * @args: 命令和参数，如{"SET","key","value"}
+      * @callback: 应答回调，所有权不转移，为NULL表示不关心应答，
+      *            客户端未启动或已停止时在调用者线程中立即以错误应答回调
+      */
+    void async_command(const std::vector<std::string>& args, IRedisCallback* callback);
+
+    /***
+      * 同步执行命令，不能在事件循环线程中调用
+      * @reply: 应答，出错时为reply_error类型
+      * @return: 如果在milliseconds毫秒内得到应答（包括错误应答），则返回true
+      */
+    bool command(const std::vector<std::string>& args, redis_reply_t* reply, uint32_t milliseconds=5000);
+
+    /** 计算键所在的槽，有{hashtag}时只计算其中的部分 */
+    static uint16_t get_key_slot(std::string_view key);
+
+    /***
+      * 得到用于路由的键，绝大多数命令即为第二个参数，
+      * EVAL和EVALSHA为numkeys之后的第一个键，没有键时返回false
+      */
+    static bool get_command_key(const std::vector<std::string>& args, std::string_view* key);
+
+public:
+    /** 得到提交的命令数 */
+    uint64_t get_command_number() const { return __atomic_load_n(&_command_number, __ATOMIC_RELAXED); }
+
+    /** 得到因并发限制被拒绝的命令数，不计入get_command_number */
+    uint64_t get_limit_rejected_number() const { return __atomic_load_n(&_limit_rejected_number, __ATOMIC_RELAXED); }
+
+    /** 得到发送的系统调用次数，远小于命令数说明流水线生效 */
+    uint64_t get_send_number() const { return _send_number; }
+
+    /** 得到收到MOVED的次数 */
+    uint64_t get_moved_number() const { return _moved_number; }
+
+    /** 得到收到ASK的次数 */
+    uint64_t get_ask_number() const { return _ask_number; }
+
+    /** 得到刷新槽映射的次数 */
+    uint64_t get_slots_refresh_number() const { return _slots_refresh_number; }
+
+private:
+    typedef std::map<ip_node_t, CRedisConnection*, ip_node_less> connection_table_t;
+
+    virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id);
+
+    // 以下均在事件循环线程中执行
+    void start();
+    void stop();
+    void drain_submissions();
+    void route(RedisRequest* request);
+    void send_to(const ip_node_t& ip_node, RedisRequest* request);
+    void refresh_slots(const ip_node_t* ip_node);
+    void update_slots(const redis_reply_t& reply, const ip_node_t& from);
+    bool redirect(CRedisConnection* connection, RedisRequest* request, const redis_reply_t& reply);
+    void on_reply(CRedisConnection* connection, RedisRequest* request, const redis_reply_t& reply);
+    void finish(RedisRequest* request, const redis_reply_t& reply);
+    void fail_connection(CRedisConnection* connection, const char* error);
+    void release_connection(CRedisConnection* connection, bool broken);
+    void mark_dirty(CRedisConnection* connection);
+    void flush_dirty();
+    CRedisConnection* get_connection(const ip_node_t& ip_node);
+
+private:
+    CEventLoop* _event_loop;
+    CTcpClientPool* _client_pool;
+    bool _cluster;
+    bool _resp3;
+    uint32_t _timeout;
+    sys::CConcurrencyLimiter* _limiter;
+    std::vector<ip_node_t> _seeds;
+    uint64_t _timer_id;
+
+private: // 提交队列，受_lock保护
+    sys::CLock _lock;
+    sys::CEvent _event;
+    std::vector<RedisRequest*> _submissions;
+    bool _drain_posted;
+    bool _stopped;
+    bool _stop_done;
+
+private: // 以下只在事件循环线程中访问
+    connection_table_t _connection_table;
+    std::vector<CRedisConnection*> _dirty_connections; /** 有待发送数据的连接 */
+    std::vector<CRedisConnection*> _dead_connections;  /** 已失效、待释放的连接 */
+    std::vector<ip_node_t> _slot_table;                /** 槽到主节点，为空表示还未取得 */
+    std::vector<RedisRequest*> _slots_waiting;         /** 等待槽映射的命令 */
+    bool _slots_refreshing;
+
+private:
+    uint64_t _command_number;
+    uint64_t _limit_rejected_number;
+    uint64_t _send_number;
+    uint64_t _moved_number;
+    uint64_t _ask_number;
+    uint64_t _slots_refresh_number;
+};
+
+/***
+  * 只读命令的对冲：同一份数据的多个副本（如主节点和各个从节点）各一个CRedisClient，
+  * 命令先发给轮转选出的副本，超过对冲延迟（见sys::CHedgeController）仍没有应答且预算足够时，
+  * 再发给下一个副本，先到的成功应答交给调用者，另一个的应答被丢弃
+  * （已发出的命令不能撤回；首个应答先于对冲延迟到达时不再发出对冲）。
+  * 只用于幂等的只读命令（GET、HGETALL、MGET等），写命令被对冲会执行两次。
+  */
+class CHedgedRedisClient
+{
+    friend class CHedgedRedisRequest;
+
+public:
+    /***
+      * @event_loop: 对冲定时器所在的事件循环，须已启动
+      * @controller: 对冲的延迟和预算，所有权不转移，可以和其它客户端共享
+      */
+    CHedgedRedisClient(CEventLoop* event_loop, sys::CHedgeController* controller);
+
+    /** 增加副本，须已create，所有权不转移，须在执行命令之前全部加入 */
+    void add_replica(CRedisClient* redis_client);
+
+    /***
+      * 异步执行只读命令，可被任意线程调用，只有一个副本时不对冲
+      * @callback: 同CRedisClient::async_command，只被回调一次
+      */
+    void async_read(const std::vector<std::string>& args, IRedisCallback* callback);
+
+    /** 同步执行只读命令，不能在事件循环线程中调用，返回值同CRedisClient::command */
+    bool read(const std::vector<std::string>& args, redis_reply_t* reply, uint32_t milliseconds=5000);
+
+private:
+    void schedule(CHedgedRedisRequest* request);
+
+private:
+    CEventLoop* _event_loop;
+    sys::CHedgeController* _controller;
+    std::vector<CRedisClient*> _replicas;
+    uint32_t _next_replica;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_REDIS_CLIENT_H
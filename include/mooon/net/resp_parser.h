@@ -0,0 +1,112 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_RESP_PARSER_H
+#define MOOON_NET_RESP_PARSER_H
+#include "mooon/net/config.h"
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+/** RESP（Redis序列化协议）应答的类型，RESP2只有前6种 */
+typedef enum
+{
+    reply_nil         = 0,  /** 空值，RESP2的$-1和*-1，RESP3的_ */
+    reply_status      = 1,  /** 简单字符串，如OK */
+    reply_error       = 2,  /** 错误，包括RESP3的块错误 */
+    reply_integer     = 3,
+    reply_string      = 4,  /** 块字符串 */
+    reply_array       = 5,
+    reply_double      = 6,
+    reply_boolean     = 7,  /** 值在integer中，1为真 */
+    reply_map         = 8,  /** 键值依次平铺在elements中 */
+    reply_set         = 9,
+    reply_push        = 10, /** 服务端推送，如订阅消息 */
+    reply_big_number  = 11, /** 值为str中的十进制字符串 */
+    reply_verbatim    = 12  /** str中不含格式前缀，如"txt:" */
+}redis_reply_type_t;
+
+/** 一个RESP应答，聚合类型的成员在elements中 */
+struct redis_reply_t
+{
+    redis_reply_type_t type;
+    std::string str; /** 状态、错误、块字符串、大数和原样字符串的值 */
+    int64_t integer;
+    double number;
+    std::vector<redis_reply_t> elements;
+
+    redis_reply_t(): type(reply_nil), integer(0), number(0) {}
+    redis_reply_t(redis_reply_type_t reply_type, std::string_view value)
+        : type(reply_type), str(value), integer(0), number(0) {}
+
+    bool is_nil() const { return reply_nil == type; }
+    bool is_error() const { return reply_error == type; }
+    void clear();
+};
+
+/***
+  * 增量的RESP2/RESP3应答解析器，数据可以任意分段到达：
+  * 已解析出的部分保存在解析器中，不完整的行或块字符串留待下次，
+  * 调用者从consumed指出的位置开始保留未用的数据，和后续收到的数据拼接后再次调用。
+  * RESP没有固定大小的消息头，不能套用CRecvMachine和CFrameRecvMachine，
+  * 因此和CHttpRequestParser一样由连接自己接收，再交给解析器。
+  * RESP3的属性（|）被解析后丢弃。
+  */
+class CRespParser
+{
+public:
+    CRespParser();
+
+    /***
+      * 解析一个应答
+      * @consumed: 输出参数，本次使用了的字节数，即使返回0也可能大于0
+      * @reply: 返回1时为解析出的应答
+      * @return: 1表示得到一个完整的应答，0表示还需要更多的数据，-1表示格式错误（之后须reset）
+      */
+    int parse(const char* data, size_t size, size_t* consumed, redis_reply_t* reply);
+
+    /** 丢弃解析了一半的应答 */
+    void reset();
+
+    /***
+      * 将命令编码为RESP的块字符串数组并追加到output，
+      * 如{"SET","k","v"}编码为*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n
+      */
+    static void format_command(const std::vector<std::string>& args, std::string* output);
+
+private:
+    struct Frame
+    {
+        redis_reply_t* node;
+        size_t next;  /** 下一个待解析成员的下标 */
+        bool attribute;
+    };
+
+    redis_reply_t* get_target();
+    bool complete_value();
+
+private:
+    redis_reply_t _root;
+    std::vector<Frame> _stack;             /** 正在解析的聚合类型 */
+    std::deque<redis_reply_t> _attributes; /** 正在解析的属性，完成后丢弃 */
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_RESP_PARSER_H
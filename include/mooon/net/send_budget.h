@@ -0,0 +1,92 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_SEND_BUDGET_H
+#define MOOON_NET_SEND_BUDGET_H
+#include <mooon/net/config.h>
+#include <mooon/sys/metrics.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 发送队列水位的观察者，由CSendMachine::set_watermarks设置，
+  * 在调用push或continue_send等的线程中被调用，回调中可以调用同一CSendMachine的push
+  */
+class ISendWatermarkObserver
+{
+public:
+    virtual ~ISendWatermarkObserver() {}
+
+    /***
+      * 排队的字节数达到高水位，或全局预算已超出且排队的字节数高于低水位，
+      * 生产者应暂停（如停止读上游连接、暂停消费Kafka），直到on_low_watermark
+      * @queued_size: 当前排队的字节数（含等待零拷贝完成的）
+      */
+    virtual void on_high_watermark(size_t queued_size) = 0;
+
+    /** 已暂停后排队的字节数降到低水位及以下，生产者可以恢复 */
+    virtual void on_low_watermark(size_t queued_size) = 0;
+};
+
+/***
+  * 所有连接的发送队列共享的内存预算，CSendMachine在push时计入、段被释放时扣除，
+  * 超出预算时各连接只要排队的字节数高于低水位即按高水位处理，
+  * 这样慢的消费者不能把整个进程的内存占满，而排队很少的连接不受影响。
+  *
+  * 度量：send_queue.bytes（当前所有连接排队的字节数）、send_queue.paused（处于暂停的连接数）、
+  * send_queue.over_budget（排队的字节数超出预算的次数）
+  */
+class CSendBudget
+{
+public:
+    /** 进程内唯一的全局预算，不释放 */
+    static CSendBudget* get_singleton();
+
+    /***
+      * 设置预算
+      * @limit: 所有连接排队的总字节数上限，为0表示不限（默认）
+      */
+    void set_limit(size_t limit) { __atomic_store_n(&_limit, limit, __ATOMIC_RELAXED); }
+    size_t get_limit() const { return __atomic_load_n(&_limit, __ATOMIC_RELAXED); }
+
+    /** 得到当前所有连接排队的字节数 */
+    size_t get_bytes() const { return static_cast<size_t>(_bytes->get()); }
+
+    /** 是否已超出预算 */
+    bool is_exceeded() const;
+
+    /** 得到处于暂停（已达高水位还未降到低水位）的连接数 */
+    size_t get_paused_number() const { return static_cast<size_t>(_paused->get()); }
+
+public: // 供CSendMachine调用
+    void add(size_t bytes);
+    void sub(size_t bytes) { _bytes->add(-static_cast<int64_t>(bytes)); }
+    void inc_paused() { _paused->add(1); }
+    void dec_paused() { _paused->add(-1); }
+
+private:
+    CSendBudget();
+
+private:
+    size_t _limit;
+    sys::CGauge* _bytes;
+    sys::CGauge* _paused;
+    sys::CCounter* _over_budget;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_SEND_BUDGET_H
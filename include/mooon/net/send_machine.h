@@ -19,31 +19,193 @@
 #ifndef MOOON_NET_SEND_MACHINE_H
 #define MOOON_NET_SEND_MACHINE_H
 #include <mooon/net/config.h>
+#include <mooon/net/io_buffer.h>
+#include <mooon/net/send_budget.h>
+#include <mooon/net/write_coalescer.h>
+#include <mooon/sys/syscall_exception.h>
+#include <deque>
+#include <errno.h>
+#include <limits.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 NET_NAMESPACE_BEGIN
 
+/***
+  * 段的释放回调，段发送完后被调用，reset时未发送完的段也会被调用
+  * @data: push时传入的数据
+  * @size: push时传入的字节数
+  * @context: push时传入的上下文
+  */
+typedef void (*send_release_t)(const char* data, size_t size, void* context);
+
+/***
+  * 发送状态机，维护一个待发送的段队列，以writev一次发送多个段，
+  * 部分发送后下次从断点继续，这样消息头和消息体不需要拼接，多个排队的响应也可一次系统调用发出。
+  *
+  * Connector需要有writev，开启零拷贝时还需要有get_fd。
+  * 段的内存在释放回调被调用之前必须保持有效且不被修改。
+  * 排队的字节数计入全局的CSendBudget，可以set_watermarks在慢的对端使队列过大时通知生产者暂停。
+  *
+  * 使用示例：
+  * send_machine.push(header, header_size);
+  * send_machine.push(body, body_size, release_body, NULL);
+  * if (utils::handle_continue == send_machine.continue_send())
+  *     // 等待可写事件后再调用continue_send
+  */
 template <class Connector>
 class CSendMachine
 {
 public:
     CSendMachine(Connector* connector);
+    ~CSendMachine();
+
+    /** 是否所有段都已经发送完 */
     bool is_finish() const;
+
+    /***
+      * 发送队列中的段，直到全部发送完或不能继续发送（非阻塞连接的发送缓冲区满）
+      * @return: 全部发送完返回utils::handle_finish，否则返回utils::handle_continue
+      * @exception: 网络错误时抛出CSyscallException异常
+      */
     utils::handle_result_t continue_send();
+
+    /***
+      * 发送一个消息，相当于push后调用continue_send，
+      * 消息的内存由reset(true)时以delete []释放
+      */
     utils::handle_result_t send(const char* msg, size_t msg_size);
+
+    /***
+      * 将一段数据加入发送队列，不发送
+      * @release: 发送完后的释放回调，为NULL表示调用者自己管理内存
+      * @context: 传给release的上下文
+      */
+    void push(const char* data, size_t size, send_release_t release=NULL, void* context=NULL);
+
+    /***
+      * 将buffer的所有片段加入发送队列，不复制，buffer被清空，
+      * 片段对块的引用在段发送完（零拷贝时为内核通知完成）后释放
+      */
+    void push(CIoBuffer* buffer);
+
+    /***
+      * 开启MSG_ZEROCOPY，一次发送的字节数不小于threshold时使用零拷贝发送，
+      * 零拷贝发送的段要等内核通知完成后才被释放，
+      * 内核的完成通知在连接的错误队列中（表现为EPOLLERR），应调用reap_zerocopy取回，
+      * continue_send也会顺带取回。
+      * @threshold: 使用零拷贝的最小字节数，零拷贝对小于约10KB的数据没有好处
+      * @return: 如果系统或连接不支持（如Unix域连接）返回false，仍使用普通方式发送
+      */
+    bool enable_zerocopy(size_t threshold);
+
+    /** 取回零拷贝的完成通知，并释放已完成的段 */
+    void reap_zerocopy();
+
+    /***
+      * 设置写合并策略，continue_send时开始一批，由策略在批结束时推出攒着的数据，
+      * 策略为coalesce_more时改用sendmsg带MSG_MORE发送，Connector需要有get_fd
+      * @coalescer: 所有权不转移，为NULL表示不合并
+      */
+    void set_coalescer(CWriteCoalescer* coalescer) { _coalescer = coalescer; }
+
+    /***
+      * 设置高低水位，排队的字节数达到high时调用observer的on_high_watermark，
+      * 之后降到low及以下时调用on_low_watermark，全局预算（CSendBudget）超出时高于low即按达到高水位处理
+      * @high: 高水位（字节数），为0表示不检查水位
+      * @low: 低水位，须小于high
+      * @observer: 所有权不转移，为NULL表示不检查水位
+      */
+    void set_watermarks(size_t high, size_t low, ISendWatermarkObserver* observer);
+
+    /** 是否处于暂停（已达高水位还未降到低水位） */
+    bool is_paused() const { return _paused; }
+
+    /** 得到排队的字节数，包括还未发送的和已零拷贝发送但未完成的，即占用的内存 */
+    size_t get_queued_size() const { return _queued_size; }
+
+    /** 得到还未发送的字节数 */
+    size_t get_remain_size() const { return _remain_size; }
+
+    /** 得到还未发送的段个数 */
+    size_t get_segment_number() const { return _segments.size(); }
+
+    /** 得到已零拷贝发送但内核还未通知完成的段个数 */
+    size_t get_zerocopy_pending_number() const { return _zerocopy_segments.size(); }
+
+    /***
+      * 清空队列，未发送完和等待零拷贝完成的段都会被释放
+      * @delete_message: 是否delete []由send传入的消息
+      */
     void reset(bool delete_message);
-    
+
+private:
+    struct Segment
+    {
+        const char* data;
+        size_t size;
+        send_release_t release;
+        void* context;
+        bool zerocopy;          /** 是否有部分以零拷贝发送 */
+        uint32_t zerocopy_seq;  /** 最后一次零拷贝发送的序号 */
+    };
+
+private:
+    ssize_t send_zerocopy(const struct iovec* iov, int iovcnt);
+    ssize_t send_more(const struct iovec* iov, int iovcnt);
+    void advance(size_t bytes, bool zerocopy, uint32_t zerocopy_seq);
+    void release(const Segment& segment);
+    void update_watermark();
+
 private:
     Connector* _connector;
-    
+    const char* _message;               /** 由send传入的消息 */
+    std::deque<Segment> _segments;      /** 待发送的段 */
+    size_t _cursor;                     /** 队首段已发送的字节数 */
+    size_t _remain_size;
+    CWriteCoalescer* _coalescer;
+
+private:
+    CSendBudget* _budget;
+    size_t _queued_size;                /** 已push还未释放的字节数 */
+    size_t _high_watermark;
+    size_t _low_watermark;
+    ISendWatermarkObserver* _observer;
+    bool _paused;
+
 private:
-    const char* _message;
-    const char* _cursor;
-    size_t _remain_size;    
+    size_t _zerocopy_threshold;         /** 为0表示未开启零拷贝 */
+    uint32_t _zerocopy_seq;             /** 下一次零拷贝发送的序号，和内核的计数一致 */
+    uint32_t _zerocopy_done;            /** 小于它的零拷贝发送均已完成 */
+    std::deque<Segment> _zerocopy_segments;
 };
 
 template <class Connector>
 CSendMachine<Connector>::CSendMachine(Connector* connector)
- :_connector(connector) 
+ :_connector(connector)
+ ,_message(NULL)
+ ,_cursor(0)
+ ,_remain_size(0)
+ ,_coalescer(NULL)
+ ,_budget(CSendBudget::get_singleton())
+ ,_queued_size(0)
+ ,_high_watermark(0)
+ ,_low_watermark(0)
+ ,_observer(NULL)
+ ,_paused(false)
+ ,_zerocopy_threshold(0)
+ ,_zerocopy_seq(0)
+ ,_zerocopy_done(0)
+{
+}
+
+template <class Connector>
+CSendMachine<Connector>::~CSendMachine()
 {
+    // 析构时不再回调
+    set_watermarks(0, 0, NULL);
     reset(false);
 }
 
@@ -51,22 +213,55 @@ CSendMachine<Connector>::CSendMachine(Connector* connector)
 template <class Connector>
 bool CSendMachine<Connector>::is_finish() const
 {
-    return 0 == _remain_size;
+    return _segments.empty();
 }
 
 // 发送消息，可能是一个消息的第一次发送，也可能是一个消息的非第一次发送
 template <class Connector>
 utils::handle_result_t CSendMachine<Connector>::continue_send()
 {
-    ssize_t bytes_sent = _connector->send(_cursor, _remain_size);
-    if (bytes_sent > -1)
+    if (_zerocopy_threshold > 0)
+        reap_zerocopy();
+    if ((_coalescer != NULL) && !_segments.empty())
+        _coalescer->begin();
+
+    while (!_segments.empty())
     {
-        _cursor += bytes_sent;
-        _remain_size -= bytes_sent;
+        struct iovec iov[IOV_MAX];
+        int iovcnt = 0;
+        size_t bytes = 0;
+
+        for (typename std::deque<Segment>::size_type i=0; (i<_segments.size()) && (iovcnt<IOV_MAX); ++i, ++iovcnt)
+        {
+            const size_t offset = (0 == i)? _cursor: 0;
+            iov[iovcnt].iov_base = const_cast<char*>(_segments[i].data + offset);
+            iov[iovcnt].iov_len = _segments[i].size - offset;
+            bytes += iov[iovcnt].iov_len;
+        }
+
+        bool zerocopy = false;
+        ssize_t bytes_sent = -2;
+        if ((_zerocopy_threshold > 0) && (bytes >= _zerocopy_threshold))
+        {
+            bytes_sent = send_zerocopy(iov, iovcnt);
+            zerocopy = bytes_sent >= 0;
+        }
+        if ((-2 == bytes_sent) && (_coalescer != NULL) && (_coalescer->get_send_flags() != 0))
+            bytes_sent = send_more(iov, iovcnt);
+        if (-2 == bytes_sent) // 未使用零拷贝，或零拷贝暂不可用
+            bytes_sent = _connector->writev(iov, iovcnt);
+        if (bytes_sent < 0)
+            break; // 不能继续发送
+
+        // 内核对每次成功的零拷贝发送计数，完成通知中的序号即为该计数
+        advance(static_cast<size_t>(bytes_sent), zerocopy, zerocopy? _zerocopy_seq++: 0);
+        if (static_cast<size_t>(bytes_sent) < bytes)
+            break; // 发送缓冲区已满
     }
-    
-    return is_finish() 
-         ? utils::handle_finish 
+
+    update_watermark();
+    return is_finish()
+         ? utils::handle_finish
          : utils::handle_continue;
 }
 
@@ -78,21 +273,266 @@ template <class Connector>
 utils::handle_result_t CSendMachine<Connector>::send(const char* msg, size_t msg_size)
 {
     _message = msg;
-    _cursor = msg;
-    _remain_size = msg_size;
-    
+    push(msg, msg_size);
+
     return continue_send();
 }
 
+template <class Connector>
+void CSendMachine<Connector>::push(const char* data, size_t size, send_release_t release, void* context)
+{
+    if (0 == size)
+    {
+        if (release != NULL)
+            (*release)(data, size, context);
+        return;
+    }
+
+    Segment segment;
+    segment.data = data;
+    segment.size = size;
+    segment.release = release;
+    segment.context = context;
+    segment.zerocopy = false;
+    segment.zerocopy_seq = 0;
+
+    _segments.push_back(segment);
+    _remain_size += size;
+    _queued_size += size;
+    _budget->add(size);
+    update_watermark();
+}
+
+template <class Connector>
+void CSendMachine<Connector>::push(CIoBuffer* buffer)
+{
+    const char* data;
+    size_t size;
+    void* context;
+
+    while (buffer->pop_slice(&data, &size, &context))
+        push(data, size, &CIoBuffer::release_slice, context);
+}
+
+template <class Connector>
+bool CSendMachine<Connector>::enable_zerocopy(size_t threshold)
+{
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+    int on = 1;
+    if (-1 == setsockopt(_connector->get_fd(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)))
+        return false;
+
+    _zerocopy_threshold = (threshold > 0)? threshold: 1;
+    return true;
+#else
+    return false;
+#endif // MSG_ZEROCOPY
+}
+
+template <class Connector>
+void CSendMachine<Connector>::reap_zerocopy()
+{
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+    for (;;)
+    {
+        char control[128];
+        struct msghdr msg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (-1 == recvmsg(_connector->get_fd(), &msg, MSG_ERRQUEUE|MSG_DONTWAIT))
+        {
+            if (EINTR == errno)
+                continue;
+            break; // EAGAIN表示没有更多的通知
+        }
+
+        for (struct cmsghdr* cmsg=CMSG_FIRSTHDR(&msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (((SOL_IP == cmsg->cmsg_level) && (IP_RECVERR == cmsg->cmsg_type))
+             || ((SOL_IPV6 == cmsg->cmsg_level) && (IPV6_RECVERR == cmsg->cmsg_type)))
+            {
+                const struct sock_extended_err* serr = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cmsg));
+
+                // 通知的是序号区间[ee_info, ee_data]，TCP上总是按顺序完成
+                if ((0 == serr->ee_errno) && (SO_EE_ORIGIN_ZEROCOPY == serr->ee_origin))
+                {
+                    if (static_cast<int32_t>(serr->ee_data + 1 - _zerocopy_done) > 0)
+                        _zerocopy_done = serr->ee_data + 1;
+                }
+            }
+        }
+    }
+
+    while (!_zerocopy_segments.empty()
+        && (static_cast<int32_t>(_zerocopy_segments.front().zerocopy_seq - _zerocopy_done) < 0))
+    {
+        release(_zerocopy_segments.front());
+        _zerocopy_segments.pop_front();
+    }
+    update_watermark();
+#endif // MSG_ZEROCOPY
+}
+
 template <class Connector>
 void CSendMachine<Connector>::reset(bool delete_message)
 {
+    // 连接将被关闭或复用，等待零拷贝完成已无意义
+    while (!_zerocopy_segments.empty())
+    {
+        release(_zerocopy_segments.front());
+        _zerocopy_segments.pop_front();
+    }
+    while (!_segments.empty())
+    {
+        release(_segments.front());
+        _segments.pop_front();
+    }
+
     if (delete_message)
         delete []_message;
 
     _message = NULL;
-    _cursor = NULL;
+    _cursor = 0;
     _remain_size = 0;
+    update_watermark();
+}
+
+template <class Connector>
+void CSendMachine<Connector>::set_watermarks(size_t high, size_t low, ISendWatermarkObserver* observer)
+{
+    // 取消水位检查时不再通知恢复，只退出暂停状态
+    if (_paused && ((0 == high) || (NULL == observer)))
+    {
+        _paused = false;
+        _budget->dec_paused();
+    }
+
+    _high_watermark = (NULL == observer)? 0: high;
+    _low_watermark = (low < high)? low: 0;
+    _observer = observer;
+    update_watermark();
+}
+
+// 返回-2表示需改用普通方式发送
+template <class Connector>
+ssize_t CSendMachine<Connector>::send_zerocopy(const struct iovec* iov, int iovcnt)
+{
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    for (;;)
+    {
+        const int flags = (_coalescer != NULL)? _coalescer->get_send_flags(): 0;
+        const ssize_t bytes_sent = sendmsg(_connector->get_fd(), &msg, flags|MSG_ZEROCOPY|MSG_DONTWAIT|MSG_NOSIGNAL);
+        if (bytes_sent != -1)
+            return bytes_sent;
+        if (EINTR == errno)
+            continue;
+        if (EWOULDBLOCK == errno)
+            return -1;
+        if (ENOBUFS == errno) // 超出了可锁定的内存（optmem_max），本次改用普通方式
+            return -2;
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmsg");
+    }
+#else
+    return -2;
+#endif // MSG_ZEROCOPY
+}
+
+// 以写合并策略给出的MSG_MORE发送，和writev一样，非阻塞连接不能继续发送时返回-1
+template <class Connector>
+ssize_t CSendMachine<Connector>::send_more(const struct iovec* iov, int iovcnt)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    for (;;)
+    {
+        const ssize_t bytes_sent = sendmsg(_connector->get_fd(), &msg, _coalescer->get_send_flags()|MSG_NOSIGNAL);
+        if (bytes_sent != -1)
+            return bytes_sent;
+        if (EINTR == errno)
+            continue;
+        if (EWOULDBLOCK == errno)
+            return -1;
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmsg");
+    }
+}
+
+// 前进bytes个字节，释放已发送完的段
+template <class Connector>
+void CSendMachine<Connector>::advance(size_t bytes, bool zerocopy, uint32_t zerocopy_seq)
+{
+    _remain_size -= bytes;
+
+    while (bytes > 0)
+    {
+        Segment& segment = _segments.front();
+        const size_t segment_remain = segment.size - _cursor;
+
+        if (zerocopy)
+        {
+            segment.zerocopy = true;
+            segment.zerocopy_seq = zerocopy_seq;
+        }
+        if (bytes < segment_remain)
+        {
+            _cursor += bytes;
+            break;
+        }
+
+        // 零拷贝发送过的段要等内核完成通知
+        bytes -= segment_remain;
+        _cursor = 0;
+        if (segment.zerocopy)
+            _zerocopy_segments.push_back(segment);
+        else
+            release(segment);
+        _segments.pop_front();
+    }
+}
+
+template <class Connector>
+void CSendMachine<Connector>::release(const Segment& segment)
+{
+    _queued_size -= segment.size;
+    _budget->sub(segment.size);
+    if (segment.release != NULL)
+        (*segment.release)(segment.data, segment.size, segment.context);
+}
+
+// 状态先改再回调，回调中调用push等重入时不会重复通知
+template <class Connector>
+void CSendMachine<Connector>::update_watermark()
+{
+    if (0 == _high_watermark)
+        return;
+
+    if (!_paused)
+    {
+        if ((_queued_size >= _high_watermark)
+         || ((_queued_size > _low_watermark) && _budget->is_exceeded()))
+        {
+            _paused = true;
+            _budget->inc_paused();
+            _observer->on_high_watermark(_queued_size);
+        }
+    }
+    else if (_queued_size <= _low_watermark)
+    {
+        _paused = false;
+        _budget->dec_paused();
+        _observer->on_low_watermark(_queued_size);
+    }
 }
 
 NET_NAMESPACE_END
@@ -0,0 +1,78 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_SIGNAL_FD_H
+#define MOOON_NET_SIGNAL_FD_H
+#include "mooon/net/epollable.h"
+#include "mooon/sys/signal_handler.h"
+#include <sys/signalfd.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 以signalfd把信号作为普通的可读事件交给事件循环（见net/event_loop.h），
+  * 不需要专门的信号线程，信号在循环线程中直接回调ISignalObserver，
+  * 没有跨线程置标志再轮询的延迟。
+  *
+  * 注意：
+  * 1) 信号必须在所有线程中都被阻塞，否则仍会按默认方式投递，
+  *    因此应在创建任何线程之前调用CSignalHandler::block_signal（CMainHelper在on_init之前已阻塞）
+  * 2) 回调在循环线程中执行，耗时的处理（如graceful_restart的排空等待）会阻塞该循环
+  *
+  * 使用示例：
+  * mooon::net::CSignalFd* signal_fd = new mooon::net::CSignalFd(main_helper);
+  * signal_fd->create(); // 监控已被CSignalHandler::block_signal阻塞的信号
+  * event_loop->post_add(signal_fd, EPOLLIN);
+  */
+class CSignalFd: public CEpollable
+{
+public:
+    /***
+      * @observer: 信号的回调对象，SIGTERM回调on_terminated，SIGCHLD回收子进程后回调on_child_end，
+      *  其它回调on_signal_handler，与CSignalHandler::handle相同
+      */
+    CSignalFd(sys::ISignalObserver* observer);
+
+    /***
+      * 创建signalfd，监控已被CSignalHandler::block_signal阻塞的信号
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create();
+
+    /***
+      * 创建signalfd，监控指定的信号集，调用者须已阻塞这些信号，
+      * 已创建时修改监控的信号集
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(const sigset_t& sigset);
+
+    /***
+      * 非阻塞地读取已发生的信号
+      * @return: 读到的信号个数，没有信号时返回0
+      * @exception: 出错抛出CSyscallException异常
+      */
+    int read_signals(struct signalfd_siginfo* siginfos, int max_number);
+
+private:
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    sys::ISignalObserver* _observer;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_SIGNAL_FD_H
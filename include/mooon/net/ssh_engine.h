@@ -0,0 +1,110 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_SSH_ENGINE_H
+#define MOOON_NET_SSH_ENGINE_H
+#include "mooon/net/config.h"
+#include "mooon/sys/syscall_exception.h"
+#include <string>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+// 一台主机的远程执行结果
+struct SshResult
+{
+    size_t index;           // 主机的序号，即add_host的返回值
+    std::string ip;
+    uint16_t port;
+    std::string output;     // 命令的标准输出
+    int exitcode;           // 命令的退出代码，命令未能执行时为-1
+    std::string exitsignal; // 命令接收到的信号
+    std::string errmsg;     // 连接、握手、认证或执行出错及超时时的出错信息
+    uint32_t milliseconds;  // 从开始连接到结束花费的时长
+
+    SshResult()
+        : index(0), port(0), exitcode(-1), milliseconds(0)
+    {
+    }
+
+    bool success() const
+    {
+        return (0 == exitcode) && exitsignal.empty() && errmsg.empty();
+    }
+};
+
+// 执行结果的观察者
+class CALLBACK_INTERFACE ISshObserver
+{
+public:
+    virtual ~ISshObserver() {}
+
+    // 一台主机结束（成功、失败或超时）时即被调用，
+    // 在引擎的执行线程中调用，多个执行线程时须线程安全
+    virtual void on_finished(const struct SshResult& result) = 0;
+};
+
+// 基于非阻塞libssh2会话的事件驱动执行引擎，
+// 少量执行线程各自用一个CEpoller驱动大量主机的连接、握手、认证和执行，
+// 每台主机的超时由时间轮管理，可限制同时进行的会话数和每秒新建的连接数，
+// 以控制文件描述符、内存和对网络的冲击。
+// 认证支持password和keyboard-interactive两种方式。
+// 使用前须调用过CLibssh2::init()。
+//
+// 使用示例：
+// net::CSshEngine engine(&observer, 4);
+// engine.set_timeout_seconds(60);
+// engine.set_max_sessions(1000);
+// engine.set_max_connects_per_second(200);
+// for (...)
+//     engine.add_host(ip, port);
+// engine.execute(username, password, command);
+class CSshEngine
+{
+public:
+    // observer 接收每台主机的执行结果
+    // num_threads 执行线程数，主机按序号轮流分给各线程
+    CSshEngine(ISshObserver* observer, int num_threads=1);
+
+    // 每台主机从开始连接到执行结束的最长时长，为0表示不限制
+    void set_timeout_seconds(uint32_t timeout_seconds) { _timeout_seconds = timeout_seconds; }
+
+    // 所有执行线程合计同时进行的会话数上限，为0表示不限制
+    void set_max_sessions(uint32_t max_sessions) { _max_sessions = max_sessions; }
+
+    // 所有执行线程合计每秒新建的连接数上限，为0表示不限制
+    void set_max_connects_per_second(uint32_t max_connects_per_second) { _max_connects_per_second = max_connects_per_second; }
+
+    // 添加被执行的主机，返回主机的序号，从0开始
+    size_t add_host(const std::string& ip, uint16_t port);
+    size_t get_host_number() const { return _hosts.size(); }
+
+    // 在所有已添加的主机上执行command，全部主机结束后返回
+    // @exception: 创建epoll等出错抛出CSyscallException异常，未编译libssh2时抛出CException异常
+    void execute(const std::string& username, const std::string& password, const std::string& command);
+
+private:
+    ISshObserver* _observer;
+    int _num_threads;
+    uint32_t _timeout_seconds;
+    uint32_t _max_sessions;
+    uint32_t _max_connects_per_second;
+    std::vector<std::pair<std::string, uint16_t> > _hosts;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_SSH_ENGINE_H
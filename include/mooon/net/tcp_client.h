@@ -22,8 +22,12 @@
 #define MOOON_NET_TCP_CLIENT_H
 #include "mooon/net/ip_node.h"
 #include "mooon/net/epollable.h"
+#include "mooon/sys/deadline.h"
+#include <vector>
 NET_NAMESPACE_BEGIN
 
+class CIoBuffer;
+
 /***
   * TCP客户端类，提供客户端的各种功能
   */
@@ -59,6 +63,15 @@ public:
     /** 设置对端端口号 */
 	void set_peer_port(uint16_t port) { _peer_port = port; }
 
+    /***
+      * 设置连接使用的本端IP地址，对之后的连接有效，默认不绑定，由内核按路由选择，
+      * 以IP_BIND_ADDRESS_NO_PORT（Linux 4.2及以上）绑定，本端端口仍在connect时才按四元组分配，
+      * 所以每个本端IP对同一对端IP端口各有一整个临时端口范围，用多个本端IP可突破单个IP的临时端口数限制，
+      * 与对端地址不同为IPV4或IPV6时不绑定
+      */
+    void set_local_ip(const ip_address_t& ip) { _local_ip = ip; _bind_local = true; }
+    void clear_local_ip() { _bind_local = false; }
+
     /** 设置连接的允许的超时毫秒数 */
 	void set_connect_timeout_milliseconds(uint32_t milli_seconds) { _milli_seconds = milli_seconds; }
 
@@ -76,6 +89,25 @@ public:
       * @exception: 连接出错或超时，抛出CSyscallException异常
       */
     void timed_connect();
+
+    /***
+      * 竞速连接，依次向各候选地址发起非阻塞连接，前一个在stagger_milliseconds内未成功时启动下一个，
+      * 前一个失败时立即启动下一个，取最先成功的，关闭其余的（类似RFC 8305的Happy Eyeballs），
+      * 候选地址的顺序即为尝试的顺序，可先用CDnsResolver::sort_happy_eyeballs排序，
+      * 总的超时由set_connect_timeout_milliseconds指定，为0表示不超时，
+      * 成功后对端为胜出的地址，不调用before_connect，也不使用TCP Fast Open
+      * @exception: 全部失败或超时，抛出CSyscallException异常，错误码为最后一个失败的原因
+      */
+    void race_connect(const std::vector<ip_node_t>& candidates, uint32_t stagger_milliseconds=250);
+
+    /***
+      * 是否使用TCP Fast Open（TCP_FASTOPEN_CONNECT，Linux 4.11及以上），对之后的连接有效，
+      * 已有该服务端的cookie时，connect立即返回成功，第一次发送的数据随SYN一起发出，省去一个RTT，
+      * 否则同普通连接，并在握手时取得cookie，服务端需在监听者上调用CListener::enable_fast_open，
+      * 由于实际的握手推迟到第一次发送，连接超时对其不起作用，连接错误也在第一次收发时才报告
+      */
+    void set_fast_open(bool enable) { _fast_open = enable; }
+    bool is_fast_open() const { return _fast_open; }
     
     /** 接收SOCKET数据
       * @buffer: 接收缓冲区
@@ -110,6 +142,10 @@ public:
       */
     ssize_t timed_send(const char* buffer, size_t buffer_size, uint32_t milliseconds);
 
+    /** 同上，但以截止时间代替超时，多次调用可共用一个截止时间 */
+    ssize_t timed_receive(char* buffer, size_t buffer_size, const sys::CDeadline& deadline);
+    ssize_t timed_send(const char* buffer, size_t buffer_size, const sys::CDeadline& deadline);
+
     /** 完整接收，如果成功返回，则一定接收了指定字节数的数据
       * @buffer: 接收缓冲区
       * @buffer_size: 接收缓冲区字节大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
@@ -118,6 +154,12 @@ public:
       */
     bool full_receive(char* buffer, size_t& buffer_size);
 
+    /***
+      * 在截止时间之前完整接收，到了截止时间还未收完，抛出错误码为ETIMEDOUT的CSyscallException异常，
+      * 不带截止时间的full_receive在CDeadlineScope中时以本线程当前的截止时间
+      */
+    bool full_receive(char* buffer, size_t& buffer_size, const sys::CDeadline& deadline);
+
     /** 完整发送，如果成功返回，则总是发送了指定字节数的数据
       * @buffer: 发送缓冲区
       * @buffer_size: 需要发送的字节数，返回实际已经发送了的字节数(不管成功还是失败或异常)
@@ -127,6 +169,9 @@ public:
       */
     void full_send(const char* buffer, size_t& buffer_size);
 
+    /** 在截止时间之前完整发送，到了截止时间还未发完，抛出错误码为ETIMEDOUT的CSyscallException异常 */
+    void full_send(const char* buffer, size_t& buffer_size, const sys::CDeadline& deadline);
+
     /** 发送文件，调用者必须保证offset+count不超过文件大小
       * @file_fd: 打开的文件句柄
       * @offset: 文件偏移位置，如果成功则返回新的偏移位置
@@ -135,6 +180,18 @@ public:
     ssize_t send_file(int file_fd, off_t *offset, size_t count);
     void full_send_file(int file_fd, off_t *offset, size_t& count);
 
+    /***
+      * 分块发送文件，用于在事件循环中发送大文件：每次sendfile最多chunk_size字节，
+      * 最多chunk_number次后即返回，不会因一个大文件长时间占住事件循环线程，
+      * 非阻塞连接的发送缓冲区满时也返回，之后等可写事件到达再调用
+      * @offset: 文件偏移位置，返回新的偏移位置
+      * @count: 还需要发送的字节数，返回还剩余的字节数
+      * @chunk_number: 为0表示不限次数，直到发送完或发送缓冲区满
+      * @return: 发送完返回utils::handle_finish，否则返回utils::handle_continue
+      * @exception: 如果发生网络错误，则抛出CSyscallException异常
+      */
+    utils::handle_result_t continue_send_file(int file_fd, off_t* offset, size_t& count, size_t chunk_size=1024*1024, uint32_t chunk_number=4);
+
     /** 采用内存映射的方式接收，并将数据存放文件，适合文件不是太大
       * @file_fd: 打开的文件句柄
       * @size: 需要写入文件的大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
@@ -152,6 +209,21 @@ public:
       * @exception: 如果发生系统调用错误，则抛出CSyscallException异常
       */
     bool full_write_tofile(int file_fd, size_t& size, size_t offset);
+
+    /***
+      * 采用splice的方式接收，并将数据存放文件，数据经管道在内核中从连接移到文件，不经过用户空间，
+      * 适合任意大小的文件，如果文件不支持splice，则经用户空间的缓冲写入，参数和返回值同full_write_tofile
+      */
+    bool full_splice_tofile(int file_fd, size_t& size, size_t offset);
+
+    /***
+      * 开启内核TLS（kTLS），之后由内核加密发送或解密接收，send_file和continue_send_file仍不经过用户空间，
+      * 握手由调用者在用户空间完成（如用OpenSSL），再以协商得到的密钥和序号开启
+      * @is_tx: 为true开启发送方向（TLS_TX），否则开启接收方向（TLS_RX）
+      * @crypto_info: 如struct tls12_crypto_info_aes_gcm_128，见linux/tls.h
+      * @return: 如果内核不支持（如未加载tls模块）或参数无效，则返回false，errno为出错原因
+      */
+    bool enable_ktls(bool is_tx, const void* crypto_info, socklen_t crypto_info_size);
     
     /***
       * 一次性读一组数据，和系统调用readv的用法相同
@@ -167,6 +239,28 @@ public:
       */
     ssize_t writev(const struct iovec *iov, int iovcnt);
 
+    /***
+      * 以readv直接收到链式缓冲区的块中（见mooon/net/io_buffer.h），不经过中间缓冲区
+      * @return: 同readv，对端关闭返回0，非阻塞连接无数据返回-1
+      * @exception: 如果发生系统调用错误，则抛出CSyscallException异常
+      */
+    ssize_t receive(CIoBuffer* buffer);
+
+    /***
+      * 以writev直接发送链式缓冲区的各片段，已发送的从buffer中丢弃
+      * @return: 同writev，非阻塞连接不能继续发送时返回-1
+      * @exception: 如果发生系统调用错误，则抛出CSyscallException异常
+      */
+    ssize_t send(CIoBuffer* buffer);
+
+    /***
+      * 是否使用io_uring收发（见mooon/net/io_uring.h），每个线程使用自己的CIoUring实例，
+      * 超时收发以链接的超时代替poll，full_receive/full_send以MSG_WAITALL一次提交，
+      * 不影响send_file等文件相关的操作
+      * @return: 如果内核不支持io_uring，则返回false，仍使用普通的系统调用
+      */
+    bool enable_io_uring(bool enable=true);
+
     /** 判断连接是否已经建立
       * @return: 如果连接已经建立，则返回true，否则返回false
       */
@@ -210,6 +304,9 @@ private:
     void* _data_channel;
     uint8_t _connect_state;     /** 连接状态，1: 已经建立，2: 正在建立连接，0: 未连接 */
     atomic_t _reconnect_times;  /** 当前已经连续的重连接次数 */
+    bool _fast_open;            /** 是否使用TCP Fast Open */
+    bool _bind_local;           /** 是否绑定_local_ip */
+    ip_address_t _local_ip;     /** 连接使用的本端IP地址 */
 };
 
 NET_NAMESPACE_END
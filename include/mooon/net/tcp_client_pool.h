@@ -0,0 +1,196 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_TCP_CLIENT_POOL_H
+#define MOOON_NET_TCP_CLIENT_POOL_H
+#include "mooon/net/event_loop.h"
+#include "mooon/net/tcp_client.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/object_pool.h"
+#include <list>
+#include <map>
+#include <set>
+NET_NAMESPACE_BEGIN
+
+class CTcpClientPool;
+
+// 节点连续连接失败时，最长多少毫秒才重连一次
+#define MAX_RETRY_MILLISECONDS 30000
+
+/***
+  * 连接池中的连接，连接对象本身来自CThreadObjectPool
+  */
+class CPooledTcpClient: public CTcpClient, public sys::CPoolObject
+{
+    friend class CTcpClientPool;
+
+public:
+    CPooledTcpClient();
+
+    /** 归还到对象池时被调用 */
+    void reset();
+
+private:
+    /** 连接完成（成功或失败）时被事件循环调用 */
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    CTcpClientPool* _client_pool;
+    void* _node;
+    uint64_t _connect_time; /** 开始连接的单调时钟毫秒数 */
+};
+
+/***
+  * 按ip_node_t区分的TCP连接池，避免每个请求都做一次三次握手。
+  * 连接由事件循环以非阻塞方式建立，不占用调用者线程：
+  * 空闲连接不足时向事件循环投递连接任务，connect完成的可写事件到达后，
+  * 连接从事件循环中剔除并放入空闲列表，再由borrow借出。
+  * 事件循环中的定时器定期做健康检查：
+  * 关闭被对端关闭或有意外数据的空闲连接、超时未连上的连接，并补足min_idle个空闲连接，
+  * 节点连续连接失败时，重连的间隔按检查间隔成倍增加，最长为MAX_RETRY_MILLISECONDS。
+  *
+  * borrow和pay_back可被任意线程调用，借出的连接为非阻塞的，
+  * 需要阻塞方式使用时可调用set_nonblock(false)，归还时不必恢复。
+  */
+class CTcpClientPool: public ITimerHandler
+{
+    friend class CPooledTcpClient;
+
+public:
+    /***
+      * 构造连接池
+      * @event_loop: 驱动连接建立和健康检查的事件循环，须已启动
+      * @min_idle: 每个节点最少保持的空闲连接数
+      * @max_idle: 每个节点最多保持的空闲连接数，归还时超出的被关闭
+      * @max_connections: 每个节点最多的连接数，包括空闲的、借出的和正在连接的
+      */
+    CTcpClientPool(CEventLoop* event_loop, uint32_t min_idle=1, uint32_t max_idle=8, uint32_t max_connections=64);
+    ~CTcpClientPool();
+
+    /***
+      * 创建连接池
+      * @object_number: 预先创建的连接对象个数，用完时从堆上创建
+      * @check_interval: 健康检查的间隔毫秒数
+      */
+    void create(uint32_t object_number, uint32_t check_interval=1000);
+
+    /***
+      * 销毁连接池，关闭所有空闲和正在建立的连接，
+      * 调用前须归还所有借出的连接，事件循环须仍在运行
+      */
+    void destroy();
+
+    /** 设置连接超时毫秒数，超时的连接在健康检查时被关闭 */
+    void set_connect_timeout_milliseconds(uint32_t milliseconds) { _connect_timeout = milliseconds; }
+
+    /***
+      * 增加节点，并开始建立min_idle个连接，
+      * 不调用也可以直接borrow，第一次borrow时自动增加
+      */
+    void add_node(const ip_node_t& ip_node);
+
+    /***
+      * 借用一个已建立的连接
+      * @milliseconds: 没有空闲连接时，等待新连接建立的最长毫秒数，
+      *                为0或在事件循环线程中调用时不等待
+      * @return: 如果没有可用的连接，则返回NULL
+      */
+    CTcpClient* borrow(const ip_node_t& ip_node, uint32_t milliseconds=0);
+
+    /***
+      * 归还借用的连接
+      * @broken: 连接是否已不可用（如收发出错或协议错乱），为true时直接关闭
+      */
+    void pay_back(CTcpClient* client, bool broken=false);
+
+    /** 得到节点的空闲连接数 */
+    uint32_t get_idle_number(const ip_node_t& ip_node) const;
+
+    /** 得到节点的连接总数，包括空闲的、借出的和正在连接的 */
+    uint32_t get_connection_number(const ip_node_t& ip_node) const;
+
+    /** 得到建立成功的连接次数 */
+    uint64_t get_connect_number() const { return _connect_number; }
+
+    /** 得到连接失败（包括超时）的次数 */
+    uint64_t get_connect_failure_number() const { return _connect_failure_number; }
+
+    /** 得到借出已有空闲连接的次数，即省去的握手次数 */
+    uint64_t get_reuse_number() const { return _reuse_number; }
+
+    /** 得到健康检查关闭的空闲连接个数 */
+    uint64_t get_evict_number() const { return _evict_number; }
+
+private:
+    struct Node
+    {
+        ip_node_t ip_node;
+        std::list<CPooledTcpClient*> idle_clients;   /** 前面的是最近归还的 */
+        std::set<CPooledTcpClient*> connecting_clients;
+        uint32_t connecting_number; /** 正在连接的，包括已投递还未开始的 */
+        uint32_t busy_number;       /** 已借出的 */
+        uint32_t waiting_number;    /** 在borrow中等待的 */
+        uint32_t failure_number;    /** 连续连接失败的次数 */
+        uint64_t retry_time;        /** 连接失败后，到这个单调时钟毫秒数之前不再发起连接 */
+    };
+
+    typedef std::map<ip_node_t, Node*, ip_node_less> node_table_t;
+
+private:
+    friend class CConnectTask;
+    friend class CPoolTimerTask;
+    friend class CPoolDestroyTask;
+
+    Node* get_node(const ip_node_t& ip_node);
+    const Node* find_node(const ip_node_t& ip_node) const;
+    uint32_t get_connection_number(const Node* node) const;
+    void post_connect(Node* node, uint32_t number);
+    void start_connect(Node* node);
+    void on_connect_result(CPooledTcpClient* client, bool success);
+    void release_client(CPooledTcpClient* client);
+    void start_timer();
+    void do_destroy();
+
+private:
+    virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id);
+
+private:
+    CEventLoop* _event_loop;
+    uint32_t _min_idle;
+    uint32_t _max_idle;
+    uint32_t _max_connections;
+    uint32_t _connect_timeout;
+    uint32_t _check_interval;
+    uint64_t _timer_id;
+    bool _destroyed;
+    sys::CThreadObjectPool<CPooledTcpClient> _object_pool;
+
+private:
+    mutable sys::CLock _lock;
+    sys::CEvent _event; /** 有新的空闲连接或已销毁 */
+    node_table_t _node_table;
+
+private:
+    uint64_t _connect_number;  /** 以下统计均在持有_lock时更新 */
+    uint64_t _connect_failure_number;
+    uint64_t _reuse_number;
+    uint64_t _evict_number;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_TCP_CLIENT_POOL_H
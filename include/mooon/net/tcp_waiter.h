@@ -25,6 +25,8 @@
 #include <sys/uio.h>
 NET_NAMESPACE_BEGIN
 
+class CIoBuffer;
+
 /***
   * TCP服务端类，提供服务端的各种功能
   */
@@ -151,6 +153,13 @@ public:
       */
     ssize_t writev(const struct iovec *iov, int iovcnt);
 
+    /***
+      * 以readv直接收到链式缓冲区的块中，以writev直接发送链式缓冲区的各片段，
+      * 同CTcpClient的receive(CIoBuffer*)和send(CIoBuffer*)
+      */
+    ssize_t receive(CIoBuffer* buffer);
+    ssize_t send(CIoBuffer* buffer);
+
 protected:
     std::string do_to_string() const;
 
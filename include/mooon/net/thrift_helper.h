@@ -26,19 +26,32 @@
  */
 #ifndef MOOON_NET_THRIFT_HELPER_H
 #define MOOON_NET_THRIFT_HELPER_H
+#include <mooon/net/backend_selector.h>
 #include <mooon/net/config.h>
+#include <mooon/sys/deadline.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/log.h>
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/read_write_lock.h>
 #include <mooon/utils/string_utils.h>
 #include <mooon/utils/scoped_ptr.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
 #include <boost/scoped_ptr.hpp>
 #include <thrift/concurrency/PosixThreadFactory.h>
 #include <thrift/concurrency/ThreadManager.h>
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/server/TNonblockingServer.h>
+#include <thrift/server/TThreadPoolServer.h>
 #include <thrift/TApplicationException.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TServerSocket.h>
 #include <thrift/transport/TSocketPool.h>
 #include <thrift/transport/TTransportException.h>
+#include <map>
+#include <time.h>
 #include <vector>
 NET_NAMESPACE_BEGIN
 
@@ -59,6 +72,31 @@ inline bool thrift_not_connected(
     return thrift_not_connected(type);
 }
 
+// 创建CThriftClientHelper的Transport，reclaim_bytes为缓冲区回收的阈值，为0表示不回收，
+// 只有TFramedTransport支持：发送的帧（flush时）或接收的帧（readEnd时）超过阈值后，
+// 缓冲区缩回默认大小，偶尔的大请求不会使长连接一直占着大块内存，
+// 其它的Transport可特化这个模板以支持
+template <class Transport>
+struct ThriftTransportCreator
+{
+    static Transport* create(const boost::shared_ptr<apache::thrift::transport::TTransport>& socket, uint32_t reclaim_bytes)
+    {
+        return new Transport(socket);
+    }
+};
+
+template <>
+struct ThriftTransportCreator<apache::thrift::transport::TFramedTransport>
+{
+    static apache::thrift::transport::TFramedTransport* create(const boost::shared_ptr<apache::thrift::transport::TTransport>& socket, uint32_t reclaim_bytes)
+    {
+        if (0 == reclaim_bytes)
+            return new apache::thrift::transport::TFramedTransport(socket);
+        return new apache::thrift::transport::TFramedTransport(
+                socket, apache::thrift::transport::TFramedTransport::DEFAULT_BUFFER_SIZE, reclaim_bytes);
+    }
+};
+
 // thrift客户端辅助类
 //
 // 使用示例：
@@ -87,9 +125,10 @@ inline bool thrift_not_connected(
 // TFDTransport (TSimpleFileTransport)
 //
 // Protocol除默认的apache::thrift::protocol::TBinaryProtocol，还可选择：
-// TCompactProtocol
+// TCompactProtocol（已包含，变长整数编码，通常比TBinaryProtocol小，服务端须对应使用TCompactProtocolFactory）
 // TJSONProtocol
 // TDebugProtocol
+// 如：mooon::net::CThriftClientHelper<ExampleServiceClient, apache::thrift::protocol::TCompactProtocol> client(ip, port);
 template <class ThriftClient,
           class Protocol=apache::thrift::protocol::TBinaryProtocol,
           class Transport=apache::thrift::transport::TFramedTransport>
@@ -132,9 +171,27 @@ public:
     // apache::thrift::transport::TTransportException
     // apache::thrift::TApplicationException
     // apache::thrift::TException
+    //
+    // 在sys::CDeadlineScope中时，连接超时不超过本线程当前的截止时间
     void connect();
     bool is_connected() const;
 
+    // 以截止时间收紧接收和发送的超时，使之后的一次或多次RPC合起来不超过截止时间，
+    // 而不是每次读写各有一个完整的超时，无限期时恢复为构造时指定的超时，如：
+    // helper.apply_deadline(mooon::sys::CDeadline(200));
+    // helper->foo();
+    // helper.apply_deadline(mooon::sys::CDeadline()); // 恢复
+    void apply_deadline(const sys::CDeadline& deadline=sys::CDeadline::get_current());
+
+    // 设置TFramedTransport缓冲区回收的阈值（见ThriftTransportCreator），为0表示不回收，
+    // 须在未连接时调用，重建Transport和Protocol，连接着时返回false
+    bool set_buffer_reclaim_bytes(uint32_t reclaim_bytes);
+
+    // 重建Transport、Protocol和ThriftClient，保留TSocket，须在未连接时调用，
+    // 丢弃调用出错时Transport缓冲区中可能残留的数据，使重新连接后可继续使用这个对象，
+    // 而不必重新创建，连接着时返回false
+    bool reset_transport();
+
     // 断开与thrift服务端的连接
     //
     // 出错时，可抛出以下几个thrift异常：
@@ -144,7 +201,7 @@ public:
     void close();
 
     apache::thrift::transport::TSocket* get_socket() { return _socket.get(); }
-    const apache::thrift::transport::TSocket get_socket() const { return _socket.get(); }
+    const apache::thrift::transport::TSocket* get_socket() const { return _socket.get(); }
     ThriftClient* get() { return _client.get(); }
     ThriftClient* get() const { return _client.get(); }
     ThriftClient* operator ->() { return get(); }
@@ -163,11 +220,13 @@ public:
 
 private:
     void init();
+    void create_transport();
 
 private:
     int _connect_timeout_milliseconds;
     int _receive_timeout_milliseconds;
     int _send_timeout_milliseconds;
+    uint32_t _buffer_reclaim_bytes;
 
 private:
     // TSocket只支持一个server，而TSocketPool是TSocket的子类支持指定多个server，运行时随机选择一个
@@ -177,6 +236,660 @@ private:
     boost::shared_ptr<ThriftClient> _client;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// thrift客户端连接池，每个server最多保持connections_per_server个连接，
+// 每次调用借出一个连接，按负载均衡策略在多个server间分摊调用：
+// balance_round_robin 轮询
+// balance_least_outstanding 选择借出（即正在调用中）的连接最少的server
+// balance_latency_aware 由CBackendSelector按延迟EWMA和在途调用数选择，
+//                       并熔断连续失败的、剔除延迟远高于其它的server，
+//                       借出到归还的时长计为调用延迟，以broken为true归还或连接失败计为失败
+// 连接失败的server在retry_seconds秒内不再被选中。
+// borrow和pay_back可被任意线程调用。
+//
+// 一个线程可同时借多个连接，以生成代码中的send_xxx和recv_xxx分开发起和接收，
+// 实现多个调用同时进行，而不是一个调完再调下一个；
+// 同一个连接上也可连续多次send_xxx后再依次recv_xxx（流水线），服务端按序应答，
+// 这时应以add_outstanding告知连接池，以便balance_least_outstanding计入。
+//
+// 使用示例：
+// mooon::net::CThriftClientPool<ExampleServiceClient> client_pool(servers);
+// mooon::net::ThriftClientPoolHelper<ExampleServiceClient> client1(&client_pool);
+// mooon::net::ThriftClientPoolHelper<ExampleServiceClient> client2(&client_pool);
+// client1->send_foo();
+// client2->send_foo();
+// client1->recv_foo();
+// client2->recv_foo();
+template <class ThriftClient,
+          class Protocol=apache::thrift::protocol::TBinaryProtocol,
+          class Transport=apache::thrift::transport::TFramedTransport>
+class CThriftClientPool
+{
+public:
+    typedef CThriftClientHelper<ThriftClient, Protocol, Transport> client_helper_t;
+
+    typedef enum
+    {
+        balance_round_robin = 0,
+        balance_least_outstanding = 1,
+        balance_latency_aware = 2
+    }balance_policy_t;
+
+public:
+    // servers thrift服务端的IP地址和端口号列表
+    // connections_per_server 每个server最多的连接数
+    // retry_seconds 连接失败的server多少秒后才再被选中
+    // backend_policy balance_latency_aware时CBackendSelector的参数
+    CThriftClientPool(const std::vector<std::pair<std::string, int> >& servers,
+                      uint32_t connections_per_server=4,
+                      int connect_timeout_milliseconds=2000,
+                      int receive_timeout_milliseconds=2000,
+                      int send_timeout_milliseconds=2000,
+                      balance_policy_t balance_policy=balance_least_outstanding,
+                      uint32_t retry_seconds=10,
+                      bool set_log_function=true,
+                      const backend_policy_t& backend_policy=backend_policy_t());
+    ~CThriftClientPool();
+
+    // 借一个已连接的连接，没有空闲的则新建，
+    // 所有server都连不上、都在重试间隔内或连接数都已达上限时返回NULL
+    client_helper_t* borrow();
+
+    // 归还借用的连接
+    // broken 连接是否已不可用（如调用抛出了TTransportException），为true时直接关闭
+    void pay_back(client_helper_t* client, bool broken=false);
+
+    // 流水线方式时，增加（number为负数则减少）连接上额外的未应答的调用数
+    void add_outstanding(client_helper_t* client, int number);
+
+    uint32_t get_server_number() const { return static_cast<uint32_t>(_servers.size()); }
+
+    // 得到第index个server正在进行的调用数
+    uint32_t get_outstanding_number(uint32_t index) const;
+
+    // 得到第index个server的连接数，包括空闲的和借出的
+    uint32_t get_connection_number(uint32_t index) const;
+
+    // balance_latency_aware时得到第index个server的延迟和熔断状态，否则返回false
+    bool get_backend_stats(uint32_t index, backend_stats_t* stats) const;
+
+    // 设置之后新建的连接的TFramedTransport缓冲区回收的阈值，
+    // 见CThriftClientHelper::set_buffer_reclaim_bytes，默认为64KB，为0表示不回收
+    void set_buffer_reclaim_bytes(uint32_t reclaim_bytes);
+
+    // 得到第index个server已关闭、待重连时复用的对象数
+    uint32_t get_closed_number(uint32_t index) const;
+
+private:
+    struct Server
+    {
+        std::string host;
+        int port;
+        std::vector<client_helper_t*> idle_clients;
+        // 已关闭的连接不删除，重连时复用其中的TSocket等对象，不必每次重建，
+        // 个数不会超过曾经同时有过的连接数
+        std::vector<client_helper_t*> closed_clients;
+        uint32_t connection_number;
+        uint32_t outstanding_number;
+        time_t retry_time; // 连接失败后，到这个时间之前不再选中
+    };
+
+    struct Borrowed
+    {
+        uint32_t index;             // 所属的server
+        uint64_t borrow_nanoseconds; // 借出的时间
+    };
+
+    // balance_latency_aware时判断server是否可被CBackendSelector选中
+    struct ServerUsable
+    {
+        const CThriftClientPool* pool;
+        time_t now;
+
+        bool operator ()(uint32_t index) const { return pool->is_usable(index, now); }
+    };
+
+private:
+    bool is_usable(uint32_t index, time_t now) const;
+    int select_server(time_t now) const;
+    client_helper_t* take_client(uint32_t index);
+    void on_connect_failure(client_helper_t* client, uint32_t index, time_t now);
+    void reclaim_client(Server& server, client_helper_t* client);
+
+private:
+    const uint32_t _connections_per_server;
+    const int _connect_timeout_milliseconds;
+    const int _receive_timeout_milliseconds;
+    const int _send_timeout_milliseconds;
+    const balance_policy_t _balance_policy;
+    const uint32_t _retry_seconds;
+    const bool _set_log_function;
+
+private:
+    mutable sys::CLock _lock;
+    uint32_t _buffer_reclaim_bytes;
+    uint32_t _next_server;
+    std::vector<Server> _servers;
+    std::map<client_helper_t*, Borrowed> _borrowed_clients;
+    utils::ScopedPtr<CBackendSelector> _selector; // 只在balance_latency_aware时创建
+};
+
+// 从连接池中借出一个连接，析构时自动归还
+template <class ThriftClient,
+          class Protocol=apache::thrift::protocol::TBinaryProtocol,
+          class Transport=apache::thrift::transport::TFramedTransport>
+class ThriftClientPoolHelper
+{
+public:
+    typedef CThriftClientPool<ThriftClient, Protocol, Transport> client_pool_t;
+
+public:
+    ThriftClientPoolHelper(client_pool_t* client_pool)
+        : _client_pool(client_pool), _client(client_pool->borrow()), _broken(false),
+          _start_nanoseconds(sys::CClock::get_nanoseconds())
+    {
+        if (NULL == _client)
+            get_borrow_failure_counter()->inc();
+    }
+
+    ~ThriftClientPoolHelper()
+    {
+        if (_client != NULL)
+        {
+            _client_pool->pay_back(_client, _broken);
+            get_hold_histogram()->record(sys::CClock::get_nanoseconds() - _start_nanoseconds);
+        }
+    }
+
+    // 是否借到了连接
+    bool ok() const { return _client != NULL; }
+
+    // 标记连接已不可用，归还时关闭
+    void set_broken() { _broken = true; }
+
+    typename client_pool_t::client_helper_t* get() { return _client; }
+    ThriftClient* operator ->() { return _client->get(); }
+
+private:
+    // 所有连接池共用的度量，hold_ns为借出到归还的时长，即调用的耗时
+    static sys::CCounter* get_borrow_failure_counter()
+    {
+        static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("thrift_pool.borrow_failure");
+        return counter;
+    }
+
+    static sys::CLatencyHistogram* get_hold_histogram()
+    {
+        static sys::CLatencyHistogram* histogram = sys::CMetricsRegistry::get_singleton()->get_histogram("thrift_pool.hold_ns");
+        return histogram;
+    }
+
+private:
+    client_pool_t* _client_pool;
+    typename client_pool_t::client_helper_t* _client;
+    bool _broken;
+    uint64_t _start_nanoseconds;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// 以复用的TMemoryBuffer和Protocol序列化和反序列化thrift对象，不必每次创建，
+// 适合网关等转发已序列化的数据（如存入缓存或消息队列的请求）：
+// 序列化的结果直接引用内部的缓冲区，反序列化以OBSERVE方式直接引用传入的数据，均不复制。
+// 非线程安全，每个线程或每个连接使用一个。
+//
+// 使用示例：
+// mooon::net::CThriftSerializer<> serializer;
+// const uint8_t* data;
+// uint32_t size;
+// serializer.serialize(request, &data, &size);
+// ...
+// serializer.deserialize(data, size, &request2);
+template <class Protocol=apache::thrift::protocol::TBinaryProtocol>
+class CThriftSerializer
+{
+public:
+    // reclaim_bytes 序列化的结果超过这个大小后，下次序列化前缓冲区缩回initial_bytes，为0表示不缩
+    CThriftSerializer(uint32_t initial_bytes=1024, uint32_t reclaim_bytes=65536)
+        : _write_buffer(new apache::thrift::transport::TMemoryBuffer(initial_bytes)),
+          _read_buffer(new apache::thrift::transport::TMemoryBuffer()),
+          _write_protocol(new Protocol(_write_buffer)),
+          _read_protocol(new Protocol(_read_buffer)),
+          _initial_bytes(initial_bytes), _reclaim_bytes(reclaim_bytes), _last_bytes(0)
+    {
+    }
+
+    // 序列化object，data指向内部的缓冲区，在下次serialize之前有效
+    template <class ThriftObject>
+    void serialize(const ThriftObject& object, const uint8_t** data, uint32_t* size)
+    {
+        if ((_reclaim_bytes > 0) && (_last_bytes > _reclaim_bytes))
+            _write_buffer->resetBuffer(_initial_bytes);
+        else
+            _write_buffer->resetBuffer(); // 保留已分配的缓冲区
+
+        object.write(_write_protocol.get());
+        uint8_t* buffer = NULL;
+        _write_buffer->getBuffer(&buffer, size);
+        *data = buffer;
+        _last_bytes = *size;
+    }
+
+    template <class ThriftObject>
+    void serialize(const ThriftObject& object, std::string* data)
+    {
+        const uint8_t* buffer = NULL;
+        uint32_t size = 0;
+        serialize(object, &buffer, &size);
+        data->assign(reinterpret_cast<const char*>(buffer), size);
+    }
+
+    // 从[data, data+size)反序列化到object，直接引用data，不复制，返回使用的字节数，
+    // 数据不完整或格式错误时抛出apache::thrift::TException
+    template <class ThriftObject>
+    uint32_t deserialize(const void* data, uint32_t size, ThriftObject* object)
+    {
+        _read_buffer->resetBuffer(static_cast<uint8_t*>(const_cast<void*>(data)), size,
+                                  apache::thrift::transport::TMemoryBuffer::OBSERVE);
+        return object->read(_read_protocol.get());
+    }
+
+    template <class ThriftObject>
+    uint32_t deserialize(const std::string& data, ThriftObject* object)
+    {
+        return deserialize(data.data(), static_cast<uint32_t>(data.size()), object);
+    }
+
+private:
+    boost::shared_ptr<apache::thrift::transport::TMemoryBuffer> _write_buffer;
+    boost::shared_ptr<apache::thrift::transport::TMemoryBuffer> _read_buffer;
+    boost::shared_ptr<apache::thrift::protocol::TProtocol> _write_protocol;
+    boost::shared_ptr<apache::thrift::protocol::TProtocol> _read_protocol;
+    const uint32_t _initial_bytes;
+    const uint32_t _reclaim_bytes;
+    uint32_t _last_bytes;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// thrift服务端的配置，用于CThriftServerHelper::serve(const ThriftServerConfig&)
+struct ThriftServerConfig
+{
+    typedef enum
+    {
+        nonblocking_server = 0, // TNonblockingServer，IO线程收发，工作线程处理
+        thread_pool_server = 1  // TThreadPoolServer，每个连接占用一个工作线程，适合连接数不多的长连接
+    }server_type_t;
+
+    // 同apache::thrift::server::TOverloadAction，只对nonblocking_server有效
+    typedef enum
+    {
+        overload_none = 0,            // 过载时不处理
+        overload_close_on_accept = 1, // 过载时关闭新接受的连接
+        overload_drain_task_queue = 2 // 过载时丢弃队列中最老的任务
+    }overload_action_t;
+
+    server_type_t server_type;
+    std::string ip;                   // 只对thread_pool_server有效，TNonblockingServer总是监听所有地址
+    uint16_t port;
+    uint32_t num_worker_threads;
+    uint32_t num_io_threads;          // 只对nonblocking_server有效
+    uint32_t max_pending_tasks;       // 任务队列的最大长度，为0表示不限
+    uint32_t max_connections;         // 超过即为过载，为0表示不限，只对nonblocking_server有效
+    uint32_t max_active_processors;   // 同时处理中的请求超过即为过载，为0表示不限，只对nonblocking_server有效
+    overload_action_t overload_action;
+    int64_t task_expire_milliseconds; // 任务在队列中超过这个毫秒数未被处理则丢弃，为0表示不丢弃，只对nonblocking_server有效
+    int64_t queue_timeout_milliseconds; // 队列满时新连接最多等待的毫秒数，超时则关闭连接，为0表示一直等，只对thread_pool_server有效
+    bool high_priority_io_threads;    // IO线程是否使用SCHED_FIFO，只对nonblocking_server有效
+    std::vector<int> worker_cpus;     // 第i个工作线程绑定到worker_cpus[i%size]，为空表示不绑定
+    std::vector<int> io_cpus;         // 第i个IO线程绑定到io_cpus[i%size]，为空表示不绑定，只对nonblocking_server有效
+
+    ThriftServerConfig()
+        : server_type(nonblocking_server), ip("0.0.0.0"), port(0),
+          num_worker_threads(1), num_io_threads(1),
+          max_pending_tasks(0), max_connections(0), max_active_processors(0),
+          overload_action(overload_none),
+          task_expire_milliseconds(0), queue_timeout_milliseconds(0),
+          high_priority_io_threads(false)
+    {
+    }
+};
+
+// thrift服务端的运行状态，由CThriftServerHelper::get_stats()取得
+struct ThriftServerStats
+{
+    size_t connection_number;        // 连接数，只对nonblocking_server有效
+    size_t active_connection_number; // 有请求在处理中的连接数，只对nonblocking_server有效
+    size_t active_processor_number;  // 处理中的请求数，只对nonblocking_server有效
+    size_t worker_number;
+    size_t idle_worker_number;
+    size_t pending_task_number;      // 队列中等待处理的任务数
+    size_t total_task_number;        // 队列中的和处理中的任务数
+    size_t expired_task_number;      // 因在队列中超时而被丢弃的任务数
+    bool overloaded;                 // 是否处于过载状态，只对nonblocking_server有效
+};
+
+// 将调用线程绑定到cpus中的下一个CPU，返回绑定的CPU
+inline int pin_thrift_thread(const std::vector<int>& cpus, volatile uint32_t* next_index)
+{
+    const uint32_t index = __sync_fetch_and_add(next_index, 1);
+    const int cpu = cpus[index % cpus.size()];
+    cpu_set_t cpu_set;
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    const int errcode = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (errcode != 0)
+        MYLOG_ERROR("bind thrift thread to cpu[%d] error: %s\n", cpu, strerror(errcode));
+    return cpu;
+}
+
+// 创建绑定CPU的工作线程
+class CThriftPinnedThreadFactory: public apache::thrift::concurrency::PosixThreadFactory
+{
+private:
+    class CPinnedRunnable: public apache::thrift::concurrency::Runnable
+    {
+    public:
+        CPinnedRunnable(boost::shared_ptr<apache::thrift::concurrency::Runnable> runnable, const CThriftPinnedThreadFactory* thread_factory)
+            : _runnable(runnable), _thread_factory(thread_factory)
+        {
+        }
+
+        virtual void run()
+        {
+            (void)pin_thrift_thread(_thread_factory->_cpus, &_thread_factory->_next_index);
+            _runnable->run();
+        }
+
+    private:
+        boost::shared_ptr<apache::thrift::concurrency::Runnable> _runnable;
+        const CThriftPinnedThreadFactory* _thread_factory;
+    };
+
+public:
+    CThriftPinnedThreadFactory(const std::vector<int>& cpus)
+        : _cpus(cpus), _next_index(0)
+    {
+    }
+
+    virtual boost::shared_ptr<apache::thrift::concurrency::Thread> newThread(boost::shared_ptr<apache::thrift::concurrency::Runnable> runnable) const
+    {
+        boost::shared_ptr<apache::thrift::concurrency::Runnable> pinned_runnable(new CPinnedRunnable(runnable, this));
+        return apache::thrift::concurrency::PosixThreadFactory::newThread(pinned_runnable);
+    }
+
+private:
+    const std::vector<int> _cpus;
+    mutable volatile uint32_t _next_index;
+};
+
+// TNonblockingServer不能指定IO线程的创建方式，
+// 但连接的createContext在其所属的IO线程中被调用，借此在IO线程第一次接受连接时绑定CPU，
+// 其它回调原样转给server_event_handler
+class CThriftPinningEventHandler: public apache::thrift::server::TServerEventHandler
+{
+public:
+    CThriftPinningEventHandler(const std::vector<int>& cpus, boost::shared_ptr<apache::thrift::server::TServerEventHandler> server_event_handler)
+        : _cpus(cpus), _next_index(0), _server_event_handler(server_event_handler)
+    {
+    }
+
+    virtual void preServe()
+    {
+        if (_server_event_handler.get() != NULL)
+            _server_event_handler->preServe();
+    }
+
+    virtual void* createContext(boost::shared_ptr<apache::thrift::protocol::TProtocol> input, boost::shared_ptr<apache::thrift::protocol::TProtocol> output)
+    {
+        static __thread bool pinned = false;
+        if (!pinned)
+        {
+            (void)pin_thrift_thread(_cpus, &_next_index);
+            pinned = true;
+        }
+
+        return (_server_event_handler.get() != NULL)
+             ? _server_event_handler->createContext(input, output)
+             : NULL;
+    }
+
+    virtual void deleteContext(void* server_context, boost::shared_ptr<apache::thrift::protocol::TProtocol> input, boost::shared_ptr<apache::thrift::protocol::TProtocol> output)
+    {
+        if (_server_event_handler.get() != NULL)
+            _server_event_handler->deleteContext(server_context, input, output);
+    }
+
+    virtual void processContext(void* server_context, boost::shared_ptr<apache::thrift::transport::TTransport> transport)
+    {
+        if (_server_event_handler.get() != NULL)
+            _server_event_handler->processContext(server_context, transport);
+    }
+
+private:
+    const std::vector<int> _cpus;
+    volatile uint32_t _next_index;
+    boost::shared_ptr<apache::thrift::server::TServerEventHandler> _server_event_handler;
+};
+
+// 按方法记录调用的度量到CMetricsRegistry，fn_name为生成代码中的“服务名.方法名”：
+// <prefix>.<fn_name>.calls          调用次数
+// <prefix>.<fn_name>.errors         处理函数抛出异常的次数
+// <prefix>.<fn_name>.in_flight      正在处理中的调用数
+// <prefix>.<fn_name>.latency_ns     从开始读请求到写完响应的时长
+// <prefix>.<fn_name>.request_bytes  请求的字节数
+// <prefix>.<fn_name>.response_bytes 响应的字节数（oneway的没有）
+// 其它回调和上下文原样转给processor_event_handler，
+// 由CThriftServerHelper::enable_metrics设置，也可直接给TProcessor::setEventHandler
+class CThriftMetricsEventHandler: public apache::thrift::TProcessorEventHandler
+{
+public:
+    CThriftMetricsEventHandler(const std::string& prefix="thrift_server",
+                               boost::shared_ptr<apache::thrift::TProcessorEventHandler> processor_event_handler=boost::shared_ptr<apache::thrift::TProcessorEventHandler>())
+        : _prefix(prefix), _processor_event_handler(processor_event_handler)
+    {
+    }
+
+    ~CThriftMetricsEventHandler()
+    {
+        for (std::map<std::string, Method*>::iterator iter=_methods.begin(); iter!=_methods.end(); ++iter)
+            delete iter->second;
+    }
+
+    virtual void* getContext(const char* fn_name, void* server_context)
+    {
+        Call* call = new Call;
+        call->method = get_method(fn_name);
+        call->start_nanoseconds = sys::CClock::get_nanoseconds();
+        call->context = (_processor_event_handler.get() != NULL)
+                      ? _processor_event_handler->getContext(fn_name, server_context)
+                      : NULL;
+        call->method->calls->inc();
+        call->method->in_flight->add(1);
+        return call;
+    }
+
+    virtual void freeContext(void* ctx, const char* fn_name)
+    {
+        Call* call = static_cast<Call*>(ctx);
+        call->method->latency->record(sys::CClock::get_nanoseconds() - call->start_nanoseconds);
+        call->method->in_flight->add(-1);
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->freeContext(call->context, fn_name);
+        delete call;
+    }
+
+    virtual void preRead(void* ctx, const char* fn_name)
+    {
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->preRead(static_cast<Call*>(ctx)->context, fn_name);
+    }
+
+    virtual void postRead(void* ctx, const char* fn_name, uint32_t bytes)
+    {
+        Call* call = static_cast<Call*>(ctx);
+        call->method->request_bytes->record(bytes);
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->postRead(call->context, fn_name, bytes);
+    }
+
+    virtual void preWrite(void* ctx, const char* fn_name)
+    {
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->preWrite(static_cast<Call*>(ctx)->context, fn_name);
+    }
+
+    virtual void postWrite(void* ctx, const char* fn_name, uint32_t bytes)
+    {
+        Call* call = static_cast<Call*>(ctx);
+        call->method->response_bytes->record(bytes);
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->postWrite(call->context, fn_name, bytes);
+    }
+
+    virtual void asyncComplete(void* ctx, const char* fn_name)
+    {
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->asyncComplete(static_cast<Call*>(ctx)->context, fn_name);
+    }
+
+    virtual void handlerError(void* ctx, const char* fn_name)
+    {
+        Call* call = static_cast<Call*>(ctx);
+        call->method->errors->inc();
+        if (_processor_event_handler.get() != NULL)
+            _processor_event_handler->handlerError(call->context, fn_name);
+    }
+
+private:
+    struct Method
+    {
+        sys::CCounter* calls;
+        sys::CCounter* errors;
+        sys::CGauge* in_flight;
+        sys::CLatencyHistogram* latency;
+        sys::CLatencyHistogram* request_bytes;
+        sys::CLatencyHistogram* response_bytes;
+    };
+
+    struct Call
+    {
+        Method* method;
+        uint64_t start_nanoseconds;
+        void* context; // processor_event_handler的上下文
+    };
+
+    // 方法数有限，第一次调用后只需读锁
+    Method* get_method(const char* fn_name)
+    {
+        {
+            sys::ReadLockHelper read_lock(_lock);
+            std::map<std::string, Method*>::const_iterator iter = _methods.find(fn_name);
+            if (iter != _methods.end())
+                return iter->second;
+        }
+
+        sys::WriteLockHelper write_lock(_lock);
+        Method*& method = _methods[fn_name];
+        if (NULL == method)
+        {
+            const std::string name = _prefix + "." + fn_name;
+            sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+            method = new Method;
+            method->calls = registry->get_counter(name + ".calls");
+            method->errors = registry->get_counter(name + ".errors");
+            method->in_flight = registry->get_gauge(name + ".in_flight");
+            method->latency = registry->get_histogram(name + ".latency_ns");
+            method->request_bytes = registry->get_histogram(name + ".request_bytes");
+            method->response_bytes = registry->get_histogram(name + ".response_bytes");
+        }
+        return method;
+    }
+
+private:
+    const std::string _prefix;
+    boost::shared_ptr<apache::thrift::TProcessorEventHandler> _processor_event_handler;
+    sys::CReadWriteLock _lock;
+    std::map<std::string, Method*> _methods;
+};
+
+// 记录连接数到CMetricsRegistry：
+// <prefix>.accepted               累计接受的连接数
+// <prefix>.connections            当前的连接数
+// <prefix>.io_thread<N>.connections 第N个（按第一次接受连接的先后）IO线程的连接数，
+//                                 TThreadPoolServer时为处理连接的工作线程
+// 其它回调和上下文原样转给server_event_handler
+class CThriftMetricsServerEventHandler: public apache::thrift::server::TServerEventHandler
+{
+public:
+    CThriftMetricsServerEventHandler(const std::string& prefix="thrift_server",
+                                     boost::shared_ptr<apache::thrift::server::TServerEventHandler> server_event_handler=boost::shared_ptr<apache::thrift::server::TServerEventHandler>())
+        : _prefix(prefix), _next_index(0), _server_event_handler(server_event_handler)
+    {
+        _accepted = sys::CMetricsRegistry::get_singleton()->get_counter(prefix + ".accepted");
+        _connections = sys::CMetricsRegistry::get_singleton()->get_gauge(prefix + ".connections");
+    }
+
+    virtual void preServe()
+    {
+        if (_server_event_handler.get() != NULL)
+            _server_event_handler->preServe();
+    }
+
+    virtual void* createContext(boost::shared_ptr<apache::thrift::protocol::TProtocol> input, boost::shared_ptr<apache::thrift::protocol::TProtocol> output)
+    {
+        // createContext在连接所属的线程中被调用，线程的度量只需取一次
+        static __thread const CThriftMetricsServerEventHandler* owner = NULL;
+        static __thread sys::CGauge* thread_connections = NULL;
+        if (owner != this)
+        {
+            const uint32_t index = __sync_fetch_and_add(&_next_index, 1);
+            thread_connections = sys::CMetricsRegistry::get_singleton()->get_gauge(
+                    utils::CStringUtils::format_string("%s.io_thread%u.connections", _prefix.c_str(), index));
+            owner = this;
+        }
+
+        Connection* connection = new Connection;
+        connection->thread_connections = thread_connections;
+        connection->context = (_server_event_handler.get() != NULL)
+                            ? _server_event_handler->createContext(input, output)
+                            : NULL;
+        _accepted->inc();
+        _connections->add(1);
+        thread_connections->add(1);
+        return connection;
+    }
+
+    virtual void deleteContext(void* server_context, boost::shared_ptr<apache::thrift::protocol::TProtocol> input, boost::shared_ptr<apache::thrift::protocol::TProtocol> output)
+    {
+        Connection* connection = static_cast<Connection*>(server_context);
+        _connections->add(-1);
+        connection->thread_connections->add(-1);
+        if (_server_event_handler.get() != NULL)
+            _server_event_handler->deleteContext(connection->context, input, output);
+        delete connection;
+    }
+
+    virtual void processContext(void* server_context, boost::shared_ptr<apache::thrift::transport::TTransport> transport)
+    {
+        if (_server_event_handler.get() != NULL)
+            _server_event_handler->processContext(static_cast<Connection*>(server_context)->context, transport);
+    }
+
+private:
+    struct Connection
+    {
+        sys::CGauge* thread_connections;
+        void* context; // server_event_handler的上下文
+    };
+
+private:
+    const std::string _prefix;
+    volatile uint32_t _next_index;
+    boost::shared_ptr<apache::thrift::server::TServerEventHandler> _server_event_handler;
+    sys::CCounter* _accepted;
+    sys::CGauge* _connections;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // thrift服务端辅助类
 //
@@ -184,6 +897,7 @@ private:
 // mooon::net::CThriftServerHelper<CExampleHandler, ExampleServiceProcessor> _thrift_server;
 // try
 // {
+//     _thrift_server.enable_metrics(); // 可选，记录各方法的调用次数、延迟和连接数
 //     _thrift_server.serve(listen_port);
 // }
 // catch (apache::thrift::TException& ex)
@@ -195,7 +909,8 @@ private:
 // TJSONProtocolFactory
 // TDebugProtocolFactory
 //
-// 只支持TNonblockingServer一种Server
+// serve(port, ...)只支持TNonblockingServer，
+// serve(const ThriftServerConfig&)还可选择TThreadPoolServer，并可限制队列长度、连接数和绑定CPU
 template <class ThriftHandler,
           class ServiceProcessor,
           class ProtocolFactory=apache::thrift::protocol::TBinaryProtocolFactory>
@@ -224,6 +939,17 @@ public:
     // 要求ThriftHandler类有方法attach(void*)
     void serve(uint16_t port, void* attached, uint8_t num_worker_threads=1, uint8_t num_io_threads=1);
 
+    // 按配置启动rpc服务，同样是同步阻塞的
+    // 任务队列满时：nonblocking_server由IO线程按overload_action处理，
+    // thread_pool_server在等待queue_timeout_milliseconds后关闭新连接
+    void serve(const ThriftServerConfig& config);
+
+    // 要求ThriftHandler类有方法attach(void*)
+    void serve(const ThriftServerConfig& config, void* attached);
+
+    // 取运行状态，可被任意线程调用，须在serve之后
+    ThriftServerStats get_stats() const;
+
     // 对于TNonblockingServer调用stop时是停止所有的IO线程，做法是设置一个结束循环标志：
     // for (uint32_t i = 0; i < ioThreads_.size(); ++i) ioThreads_[i]->stop();
     // void TNonblockingIOThread::stop() {
@@ -264,6 +990,10 @@ public:
         return _server_event_handler;
     }
 
+    // 以CThriftMetricsEventHandler和CThriftMetricsServerEventHandler记录各方法的调用和连接数，
+    // 构造时指定的event handler仍被调用，须在serve之前调用，且只调用一次
+    void enable_metrics(const std::string& prefix="thrift_server");
+
 private:
     // 被构造函数调用
     void init1(
@@ -276,6 +1006,8 @@ private:
             uint16_t port,
             uint8_t num_worker_threads,
             uint8_t num_io_threads);
+    // 被serve(const ThriftServerConfig&)调用
+    void init3(const ThriftServerConfig& config);
 
 private:
     // Virtual interface class that can handle events from the server core.
@@ -340,7 +1072,8 @@ CThriftClientHelper<ThriftClient, Protocol, Transport>::CThriftClientHelper(
         int connect_timeout_milliseconds, int receive_timeout_milliseconds, int send_timeout_milliseconds, bool set_log_function)
         : _connect_timeout_milliseconds(connect_timeout_milliseconds),
           _receive_timeout_milliseconds(receive_timeout_milliseconds),
-          _send_timeout_milliseconds(send_timeout_milliseconds)
+          _send_timeout_milliseconds(send_timeout_milliseconds),
+          _buffer_reclaim_bytes(0)
 {
     if (set_log_function)
         set_thrift_debug_log_function();
@@ -359,7 +1092,8 @@ CThriftClientHelper<ThriftClient, Protocol, Transport>::CThriftClientHelper(
         bool randomize, bool always_try_last, bool set_log_function)
         : _connect_timeout_milliseconds(connect_timeout_milliseconds),
           _receive_timeout_milliseconds(receive_timeout_milliseconds),
-          _send_timeout_milliseconds(send_timeout_milliseconds)
+          _send_timeout_milliseconds(send_timeout_milliseconds),
+          _buffer_reclaim_bytes(0)
 {
     if (set_log_function)
         set_thrift_debug_log_function();
@@ -380,15 +1114,41 @@ void CThriftClientHelper<ThriftClient, Protocol, Transport>::init()
     _socket->setConnTimeout(_connect_timeout_milliseconds);
     _socket->setRecvTimeout(_receive_timeout_milliseconds);
     _socket->setSendTimeout(_send_timeout_milliseconds);
+    create_transport();
+}
 
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientHelper<ThriftClient, Protocol, Transport>::create_transport()
+{
     // Transport默认为apache::thrift::transport::TFramedTransport
-    _transport.reset(new Transport(_socket));
+    _transport.reset(ThriftTransportCreator<Transport>::create(_socket, _buffer_reclaim_bytes));
     // Protocol默认为apache::thrift::protocol::TBinaryProtocol
     _protocol.reset(new Protocol(_transport));
     // 服务端的Client
     _client.reset(new ThriftClient(_protocol));
 }
 
+template <class ThriftClient, class Protocol, class Transport>
+bool CThriftClientHelper<ThriftClient, Protocol, Transport>::set_buffer_reclaim_bytes(uint32_t reclaim_bytes)
+{
+    if (_transport->isOpen())
+        return false;
+
+    _buffer_reclaim_bytes = reclaim_bytes;
+    create_transport();
+    return true;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+bool CThriftClientHelper<ThriftClient, Protocol, Transport>::reset_transport()
+{
+    if (_transport->isOpen())
+        return false;
+
+    create_transport();
+    return true;
+}
+
 template <class ThriftClient, class Protocol, class Transport>
 CThriftClientHelper<ThriftClient, Protocol, Transport>::~CThriftClientHelper()
 {
@@ -400,6 +1160,8 @@ void CThriftClientHelper<ThriftClient, Protocol, Transport>::connect()
 {
     if (!_transport->isOpen())
     {
+        _socket->setConnTimeout(static_cast<int>(sys::CDeadline::get_current().clamp_milliseconds(_connect_timeout_milliseconds)));
+
         // 如果Transport为TFramedTransport，则实际调用：TFramedTransport::open -> TSocketPool::open
         _transport->open();
         // 当"TSocketPool::open: all connections failed"时，
@@ -407,6 +1169,14 @@ void CThriftClientHelper<ThriftClient, Protocol, Transport>::connect()
     }
 }
 
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientHelper<ThriftClient, Protocol, Transport>::apply_deadline(const sys::CDeadline& deadline)
+{
+    // TSocket的超时为0表示不超时，clamp_milliseconds同样以0表示不超时
+    _socket->setRecvTimeout(static_cast<int>(deadline.clamp_milliseconds(_receive_timeout_milliseconds)));
+    _socket->setSendTimeout(static_cast<int>(deadline.clamp_milliseconds(_send_timeout_milliseconds)));
+}
+
 template <class ThriftClient, class Protocol, class Transport>
 bool CThriftClientHelper<ThriftClient, Protocol, Transport>::is_connected() const
 {
@@ -434,6 +1204,273 @@ uint16_t CThriftClientHelper<ThriftClient, Protocol, Transport>::get_port() cons
     return static_cast<uint16_t>(_socket->getPort());
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <class ThriftClient, class Protocol, class Transport>
+CThriftClientPool<ThriftClient, Protocol, Transport>::CThriftClientPool(
+        const std::vector<std::pair<std::string, int> >& servers,
+        uint32_t connections_per_server,
+        int connect_timeout_milliseconds, int receive_timeout_milliseconds, int send_timeout_milliseconds,
+        balance_policy_t balance_policy, uint32_t retry_seconds, bool set_log_function,
+        const backend_policy_t& backend_policy)
+        : _connections_per_server(connections_per_server),
+          _connect_timeout_milliseconds(connect_timeout_milliseconds),
+          _receive_timeout_milliseconds(receive_timeout_milliseconds),
+          _send_timeout_milliseconds(send_timeout_milliseconds),
+          _balance_policy(balance_policy),
+          _retry_seconds(retry_seconds),
+          _set_log_function(set_log_function),
+          _buffer_reclaim_bytes(65536),
+          _next_server(0)
+{
+    _servers.resize(servers.size());
+    for (typename std::vector<Server>::size_type i=0; i<servers.size(); ++i)
+    {
+        _servers[i].host = servers[i].first;
+        _servers[i].port = servers[i].second;
+        _servers[i].connection_number = 0;
+        _servers[i].outstanding_number = 0;
+        _servers[i].retry_time = 0;
+    }
+    if ((balance_latency_aware == balance_policy) && !servers.empty())
+        _selector.reset(new CBackendSelector(static_cast<uint32_t>(servers.size()), backend_policy));
+}
+
+// 调用者须先归还所有借出的连接
+template <class ThriftClient, class Protocol, class Transport>
+CThriftClientPool<ThriftClient, Protocol, Transport>::~CThriftClientPool()
+{
+    for (typename std::vector<Server>::size_type i=0; i<_servers.size(); ++i)
+    {
+        for (typename std::vector<client_helper_t*>::size_type j=0; j<_servers[i].idle_clients.size(); ++j)
+            delete _servers[i].idle_clients[j];
+        for (typename std::vector<client_helper_t*>::size_type j=0; j<_servers[i].closed_clients.size(); ++j)
+            delete _servers[i].closed_clients[j];
+    }
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+typename CThriftClientPool<ThriftClient, Protocol, Transport>::client_helper_t*
+CThriftClientPool<ThriftClient, Protocol, Transport>::borrow()
+{
+    // 每个server最多尝试一次
+    for (typename std::vector<Server>::size_type i=0; i<_servers.size(); ++i)
+    {
+        const time_t now = time(NULL);
+        client_helper_t* client = NULL;
+        int index;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            index = select_server(now);
+            if (-1 == index)
+                return NULL;
+            client = take_client(static_cast<uint32_t>(index));
+        }
+
+        // 在锁外连接，不阻塞其它线程借还
+        try
+        {
+            client->connect();
+            return client;
+        }
+        catch (apache::thrift::TException& ex)
+        {
+            MYLOG_ERROR("connect %s failed: %s\n", client->str().c_str(), ex.what());
+            on_connect_failure(client, static_cast<uint32_t>(index), now);
+        }
+    }
+
+    return NULL;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientPool<ThriftClient, Protocol, Transport>::pay_back(client_helper_t* client, bool broken)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    typename std::map<client_helper_t*, Borrowed>::iterator iter = _borrowed_clients.find(client);
+    if (iter == _borrowed_clients.end())
+        return;
+
+    Server& server = _servers[iter->second.index];
+    --server.outstanding_number;
+    if (_selector.get() != NULL)
+        _selector->report(iter->second.index, !broken, sys::CClock::get_nanoseconds() - iter->second.borrow_nanoseconds);
+    _borrowed_clients.erase(iter);
+    if (broken || !client->is_connected())
+    {
+        --server.connection_number;
+        try
+        {
+            client->close();
+        }
+        catch (apache::thrift::TException&)
+        {
+        }
+        reclaim_client(server, client);
+    }
+    else
+    {
+        server.idle_clients.push_back(client);
+    }
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientPool<ThriftClient, Protocol, Transport>::add_outstanding(client_helper_t* client, int number)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    typename std::map<client_helper_t*, Borrowed>::iterator iter = _borrowed_clients.find(client);
+    if (iter != _borrowed_clients.end())
+        _servers[iter->second.index].outstanding_number += number;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+uint32_t CThriftClientPool<ThriftClient, Protocol, Transport>::get_outstanding_number(uint32_t index) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    return _servers[index].outstanding_number;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+uint32_t CThriftClientPool<ThriftClient, Protocol, Transport>::get_connection_number(uint32_t index) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    return _servers[index].connection_number;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+bool CThriftClientPool<ThriftClient, Protocol, Transport>::get_backend_stats(uint32_t index, backend_stats_t* stats) const
+{
+    if (NULL == _selector.get())
+        return false;
+    _selector->get_stats(index, stats);
+    return true;
+}
+
+// 跳过在重试间隔内的和连接数已满且没有空闲连接的server
+template <class ThriftClient, class Protocol, class Transport>
+bool CThriftClientPool<ThriftClient, Protocol, Transport>::is_usable(uint32_t index, time_t now) const
+{
+    const Server& server = _servers[index];
+    if (server.retry_time > now)
+        return false;
+    return !server.idle_clients.empty() || (server.connection_number < _connections_per_server);
+}
+
+// 轮询时从_next_server开始取第一个可用的，按延迟时由CBackendSelector选择，否则取正在进行的调用最少的
+template <class ThriftClient, class Protocol, class Transport>
+int CThriftClientPool<ThriftClient, Protocol, Transport>::select_server(time_t now) const
+{
+    int selected = -1;
+
+    if (_selector.get() != NULL)
+    {
+        ServerUsable usable;
+        usable.pool = this;
+        usable.now = now;
+        return _selector->select(usable);
+    }
+
+    for (typename std::vector<Server>::size_type i=0; i<_servers.size(); ++i)
+    {
+        const uint32_t index = static_cast<uint32_t>((_next_server + i) % _servers.size());
+        const Server& server = _servers[index];
+
+        if (!is_usable(index, now))
+            continue;
+
+        if (balance_round_robin == _balance_policy)
+            return static_cast<int>(index);
+        if ((-1 == selected) || (server.outstanding_number < _servers[selected].outstanding_number))
+            selected = static_cast<int>(index);
+    }
+
+    return selected;
+}
+
+// 持有_lock时调用，优先取最近归还的空闲连接
+template <class ThriftClient, class Protocol, class Transport>
+typename CThriftClientPool<ThriftClient, Protocol, Transport>::client_helper_t*
+CThriftClientPool<ThriftClient, Protocol, Transport>::take_client(uint32_t index)
+{
+    Server& server = _servers[index];
+    client_helper_t* client;
+
+    _next_server = index + 1;
+    if (!server.idle_clients.empty())
+    {
+        client = server.idle_clients.back();
+        server.idle_clients.pop_back();
+    }
+    else if (!server.closed_clients.empty())
+    {
+        // 复用已关闭的，由borrow重新连接
+        client = server.closed_clients.back();
+        server.closed_clients.pop_back();
+        ++server.connection_number;
+    }
+    else
+    {
+        client = new client_helper_t(
+                server.host, static_cast<uint16_t>(server.port),
+                _connect_timeout_milliseconds, _receive_timeout_milliseconds, _send_timeout_milliseconds,
+                _set_log_function);
+        client->set_buffer_reclaim_bytes(_buffer_reclaim_bytes);
+        ++server.connection_number;
+    }
+
+    Borrowed borrowed;
+    borrowed.index = index;
+    borrowed.borrow_nanoseconds = sys::CClock::get_nanoseconds();
+    ++server.outstanding_number;
+    _borrowed_clients.insert(std::make_pair(client, borrowed));
+    return client;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientPool<ThriftClient, Protocol, Transport>::on_connect_failure(client_helper_t* client, uint32_t index, time_t now)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    Server& server = _servers[index];
+
+    server.retry_time = now + _retry_seconds;
+    --server.outstanding_number;
+    --server.connection_number;
+    if (_selector.get() != NULL)
+        _selector->report(index, false, 0);
+    _borrowed_clients.erase(client);
+    reclaim_client(server, client);
+}
+
+// 已关闭的连接放入closed_clients待复用，重建Transport丢弃出错时可能残留的数据，
+// 超过每个server的连接数上限的（如期间调小了）才删除
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientPool<ThriftClient, Protocol, Transport>::reclaim_client(Server& server, client_helper_t* client)
+{
+    if ((server.closed_clients.size() + server.connection_number >= _connections_per_server)
+     || !client->set_buffer_reclaim_bytes(_buffer_reclaim_bytes))
+    {
+        delete client;
+    }
+    else
+    {
+        server.closed_clients.push_back(client);
+    }
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+void CThriftClientPool<ThriftClient, Protocol, Transport>::set_buffer_reclaim_bytes(uint32_t reclaim_bytes)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _buffer_reclaim_bytes = reclaim_bytes;
+}
+
+template <class ThriftClient, class Protocol, class Transport>
+uint32_t CThriftClientPool<ThriftClient, Protocol, Transport>::get_closed_number(uint32_t index) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    return static_cast<uint32_t>(_servers[index].closed_clients.size());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
 CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::CThriftServerHelper(
@@ -517,6 +1554,65 @@ void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::serv
     _thread_manager->join();
 }
 
+template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
+void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::serve(const ThriftServerConfig& config)
+{
+    init3(config);
+
+    // !!!注意调用run()的进程或线程会被阻塞
+    _server->run();
+    _thread_manager->stop();
+}
+
+template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
+void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::serve(const ThriftServerConfig& config, void* attached)
+{
+    init3(config);
+
+    // 关联
+    if (attached != NULL)
+        _handler->attach(attached);
+
+    // !!!注意调用run()的进程或线程会被阻塞
+    _server->run();
+    _thread_manager->stop();
+}
+
+template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
+ThriftServerStats CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::get_stats() const
+{
+    ThriftServerStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    if (_thread_manager != NULL)
+    {
+        stats.worker_number = _thread_manager->workerCount();
+        stats.idle_worker_number = _thread_manager->idleWorkerCount();
+        stats.pending_task_number = _thread_manager->pendingTaskCount();
+        stats.total_task_number = _thread_manager->totalTaskCount();
+        stats.expired_task_number = _thread_manager->expiredTaskCount();
+    }
+
+    apache::thrift::server::TNonblockingServer* server = dynamic_cast<apache::thrift::server::TNonblockingServer*>(_server.get());
+    if (server != NULL)
+    {
+        stats.connection_number = server->getNumConnections();
+        stats.active_connection_number = server->getNumActiveConnections();
+        stats.active_processor_number = server->getNumActiveProcessors();
+        stats.overloaded = server->isOverloaded();
+    }
+
+    return stats;
+}
+
+template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
+void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::enable_metrics(const std::string& prefix)
+{
+    _processor->setEventHandler(boost::shared_ptr<apache::thrift::TProcessorEventHandler>(
+            new CThriftMetricsEventHandler(prefix, _processor->getEventHandler())));
+    _server_event_handler.reset(new CThriftMetricsServerEventHandler(prefix, _server_event_handler));
+}
+
 template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
 void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::stop()
 {
@@ -573,5 +1669,59 @@ void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::init
     // 因为一旦调用了run()后，调用线程或进程就被阻塞了。
 }
 
+// 被serve(const ThriftServerConfig&)调用
+template <class ThriftHandler, class ServiceProcessor, class ProtocolFactory>
+void CThriftServerHelper<ThriftHandler, ServiceProcessor, ProtocolFactory>::init3(const ThriftServerConfig& config)
+{
+    // pendingTaskCountMax为0表示不限
+    _thread_manager = apache::thrift::server::ThreadManager::newSimpleThreadManager(config.num_worker_threads, config.max_pending_tasks);
+    if (config.worker_cpus.empty())
+        _thread_factory.reset(new apache::thrift::concurrency::PosixThreadFactory());
+    else
+        _thread_factory.reset(new CThriftPinnedThreadFactory(config.worker_cpus));
+    _thread_manager->threadFactory(_thread_factory);
+    _thread_manager->start();
+
+    if (ThriftServerConfig::thread_pool_server == config.server_type)
+    {
+        boost::shared_ptr<apache::thrift::transport::TServerTransport> server_socket(
+                (config.ip.empty() || ("0.0.0.0" == config.ip))
+              ? new apache::thrift::transport::TServerSocket(config.port)
+              : new apache::thrift::transport::TServerSocket(config.ip, config.port));
+        boost::shared_ptr<apache::thrift::transport::TTransportFactory> transport_factory(
+                new apache::thrift::transport::TFramedTransportFactory());
+
+        // 队列满时，TThreadPoolServer等待timeout毫秒后放弃并关闭新连接
+        apache::thrift::server::TThreadPoolServer* server = new apache::thrift::server::TThreadPoolServer(
+                _processor, server_socket, transport_factory, _protocol_factory, _thread_manager);
+        server->setTimeout(config.queue_timeout_milliseconds);
+        server->setServerEventHandler(_server_event_handler);
+        _server.reset(server);
+    }
+    else
+    {
+        apache::thrift::server::TNonblockingServer* server = new apache::thrift::server::TNonblockingServer(
+                _processor, _protocol_factory, config.port, _thread_manager);
+        server->setNumIOThreads(config.num_io_threads);
+        server->setUseHighPriorityIOThreads(config.high_priority_io_threads);
+        if (config.max_connections > 0)
+            server->setMaxConnections(config.max_connections);
+        if (config.max_active_processors > 0)
+            server->setMaxActiveProcessors(config.max_active_processors);
+        server->setOverloadAction(static_cast<apache::thrift::server::TOverloadAction>(config.overload_action));
+        if (config.task_expire_milliseconds > 0)
+            server->setTaskExpireTime(config.task_expire_milliseconds);
+
+        if (config.io_cpus.empty())
+            server->setServerEventHandler(_server_event_handler);
+        else
+            server->setServerEventHandler(boost::shared_ptr<apache::thrift::server::TServerEventHandler>(
+                    new CThriftPinningEventHandler(config.io_cpus, _server_event_handler)));
+        _server.reset(server);
+    }
+
+    // 不要调用_server->run()，交给serve()来调用
+}
+
 NET_NAMESPACE_END
 #endif // MOOON_NET_THRIFT_HELPER_H
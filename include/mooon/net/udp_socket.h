@@ -19,8 +19,92 @@
 #ifndef MOOON_NET_UDP_SOCKET_H
 #define MOOON_NET_UDP_SOCKET_H
 #include "mooon/net/epollable.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
 NET_NAMESPACE_BEGIN
 
+/***
+  * 得到从timestamp（CLOCK_REALTIME，如软件接收时间戳）到现在的纳秒数，
+  * 用于度量报文从到达内核到被处理的延迟，硬件时间戳须网卡时钟已与系统时间同步（如ptp4l和phc2sys）才有意义
+  */
+int64_t get_timestamp_latency_nanoseconds(const struct timespec& timestamp);
+
+/***
+  * 批量收发UDP消息用的预分配消息区，供CUdpSocket的receive_batch和send_batch使用，
+  * 包含message_number个槽位，每个槽位有message_size字节的数据区、地址和控制信息区，
+  * 全部在构造时一次分配，收发过程中不再分配内存。
+  * 非线程安全，通常一个线程一个。
+  */
+class CUdpMessageArena
+{
+    friend class CUdpSocket;
+    friend class CXdpSocket;
+
+public:
+    /***
+      * @message_number: 槽位个数，即一次系统调用最多收发的消息数
+      * @message_size: 每个槽位的数据区字节数，开启GRO时应为65535以容纳合并后的消息
+      */
+    CUdpMessageArena(uint32_t message_number=64, uint32_t message_size=1472);
+    ~CUdpMessageArena();
+
+    /** 得到槽位个数 */
+    uint32_t get_capacity() const { return _message_number; }
+
+    /** 得到每个槽位的数据区字节数 */
+    uint32_t get_message_size() const { return _message_size; }
+
+    /** 得到有效的消息个数，接收后为收到的个数，发送前为已add的个数 */
+    uint32_t get_number() const { return _number; }
+
+    /** 清空，以便重新add */
+    void clear() { _number = 0; }
+
+    /***
+      * 增加一个待发送的消息，数据被复制到槽位中
+      * @return: 如果槽位已用完或data_size超过槽位大小，则返回false
+      */
+    bool add(const void* data, size_t data_size, const struct sockaddr_in& to_addr);
+
+    /** 得到第index个消息的数据 */
+    const char* get_data(uint32_t index) const { return _buffer + static_cast<size_t>(_message_size)*index; }
+    char* get_data(uint32_t index) { return _buffer + static_cast<size_t>(_message_size)*index; }
+
+    /** 得到第index个消息的字节数 */
+    size_t get_size(uint32_t index) const { return _iovecs[index].iov_len; }
+
+    /** 得到第index个消息的源地址（接收）或目标地址（发送） */
+    const struct sockaddr_in& get_addr(uint32_t index) const { return _addrs[index]; }
+
+    /***
+      * 得到第index个消息的GRO分段大小，
+      * 开启GRO时多个同源的消息可能被合并成一个，按此大小切分即为原来的各个消息，
+      * 为0表示没有合并
+      */
+    uint16_t get_segment_size(uint32_t index) const;
+
+    /***
+      * 得到第index个消息的接收时间戳，须先调用CEpollable::enable_timestamping，
+      * 有硬件时间戳时取硬件的，否则取软件的
+      * @return: 没有时间戳时返回false
+      */
+    bool get_timestamp(uint32_t index, struct timespec* timestamp) const;
+
+private:
+    void prepare_receive();
+
+private:
+    uint32_t _message_number;
+    uint32_t _message_size;
+    uint32_t _number;
+    char* _buffer;
+    char* _control_buffer;
+    struct mmsghdr* _mmsghdrs;
+    struct iovec* _iovecs;
+    struct sockaddr_in* _addrs;
+};
+
 // UDP不分服务端和客户端，
 // 但如果仅做服务端或即做服务端又做客户端时，都必须调用listen()，
 // 仅做客户端使用时，可不必调用listen()
@@ -50,8 +134,30 @@ public:
     int receive_from(void* buffer, size_t buffer_size, uint32_t* from_ip, uint16_t* from_port);
     int receive_from(void* buffer, size_t buffer_size, struct sockaddr_in* from_addr);
 
+    // 同时得到接收时间戳（须先调用enable_timestamping），没有时间戳时timestamp被置0，返回值同receive_from
+    int receive_from(void* buffer, size_t buffer_size, struct sockaddr_in* from_addr, struct timespec* timestamp);
+
     int timed_receive_from(void* buffer, size_t buffer_size, uint32_t* from_ip, uint16_t* from_port, uint32_t milliseconds);
     int timed_receive_from(void* buffer, size_t buffer_size, struct sockaddr_in* from_addr, uint32_t milliseconds);
+
+    // 以recvmmsg批量接收，一次系统调用最多接收arena->get_capacity()个消息，
+    // 阻塞模式下等待到第一个消息到达，然后取走所有已到达的（MSG_WAITFORONE），
+    // 成功返回接收到的消息个数，同arena->get_number()，如果返回-1表示为非阻塞模式没有数据可接收，出错抛出异常
+    int receive_batch(CUdpMessageArena* arena);
+    int timed_receive_batch(CUdpMessageArena* arena, uint32_t milliseconds);
+
+    // 以sendmmsg批量发送arena中从第offset个开始的消息，
+    // 成功返回实际发送的消息个数，可能少于待发送的个数，如果返回-1表示为非阻塞模式不能发送，出错抛出异常
+    int send_batch(CUdpMessageArena* arena, uint32_t offset=0);
+
+    // 以GSO（UDP_SEGMENT）发送，buffer按segment_size切分成多个消息由内核或网卡分段，
+    // 一次系统调用发送多个同目标的消息，buffer_size不能超过65507，也不能超过64个分段
+    // 返回值同send_to，内核不支持时抛出异常，errno为EINVAL或ENOPROTOOPT
+    int send_gso(const void* buffer, size_t buffer_size, uint16_t segment_size, const struct sockaddr_in& to_addr);
+
+    // 开启或关闭GRO（UDP_GRO），开启后同源的多个消息可能被合并成一个接收，
+    // 由CUdpMessageArena::get_segment_size得到分段大小，内核不支持时返回false
+    bool enable_gro(bool enable);
 };
 
 NET_NAMESPACE_END
@@ -179,6 +179,14 @@ public:
       * @exception: 无异常抛出
       */
     static bool get_ip_address(const char* hostname, string_ip_array_t& ip_array, std::string& errinfo);
+
+    /***
+      * 同get_ip_address，但通过CDnsResolver::get_default()解析，
+      * 结果被缓存并提前刷新，DNS故障时使用过期的结果，适合重连时调用
+      * @milliseconds: 没有可用的缓存时最多等待的毫秒数
+      * @exception: 无异常抛出
+      */
+    static bool resolve_ip_address(const char* hostname, string_ip_array_t& ip_array, std::string& errinfo, uint32_t milliseconds=5000);
     
     /** 得到网卡名和对应的IP
       * @eth_ip_array: 用于保存所有获取到的IP地址
@@ -219,6 +227,14 @@ public:
       * @return: 转换成功返回true，否则返回false
       */
     static bool string_toipv6(const char* source, uint32_t* ipv6);
+
+    /***
+      * 同上，但source不必以'\0'结尾，只解析[source, source+size)，
+      * 接受的格式与inet_pton完全相同，但手写的解析器不经过地址族分派、不求字符串长度，
+      * 每个字节只比较一次，适用于每个请求或报文都须解析地址的场合，如解析HTTP头中的X-Forwarded-For
+      */
+    static bool string_toipv4(const char* source, size_t size, uint32_t& ipv4);
+    static bool string_toipv6(const char* source, size_t size, uint32_t* ipv6);
     
     /** 判断传入的字符串是否为接口名，如：eth0等
       * @return: 如果str是接口名，则返回true，否则返回false
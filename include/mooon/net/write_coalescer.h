@@ -0,0 +1,112 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_WRITE_COALESCER_H
+#define MOOON_NET_WRITE_COALESCER_H
+#include "mooon/net/epollable.h"
+NET_NAMESPACE_BEGIN
+
+class CEventLoop;
+
+/***
+  * TCP写合并策略，在一批响应写出期间让内核把小块数据攒成满的报文再发出，
+  * 一批结束时（事件循环本轮处理完或显式flush）立即发出剩余的数据，
+  * 这样既减少小包个数，又不会像Nagle算法那样让最后一个不满的报文等待ACK。
+  *
+  * coalesce_cork：批开始时设置TCP_CORK，flush时去掉，适用于任何写方式（包括writev和sendfile）；
+  * coalesce_more：批中的send/sendmsg带上get_send_flags()返回的MSG_MORE，
+  *                flush时以设置TCP_NODELAY推出剩余的数据，不需要批开始时的setsockopt。
+  * 低延迟模式下不合并，begin什么也不做，get_send_flags返回0。
+  * 内核对TCP_CORK和MSG_MORE攒着的数据最多等待200毫秒。
+  *
+  * 非线程安全，只能在连接所属事件循环的线程中使用，对象须在连接关闭之前销毁或flush。
+  *
+  * 使用示例：
+  * coalescer.begin();
+  * send_machine.push(header, header_size);
+  * send_machine.continue_send();
+  * // 本轮事件处理结束时，事件循环自动调用coalescer.flush()
+  */
+class CWriteCoalescer
+{
+public:
+    typedef enum
+    {
+        coalesce_none = 0, /** 不合并 */
+        coalesce_cork = 1, /** 使用TCP_CORK */
+        coalesce_more = 2  /** 使用MSG_MORE */
+    }coalesce_policy_t;
+
+public:
+    /***
+      * 构造写合并策略
+      * @epollable: 被合并写的TCP连接，所有权不转移
+      * @event_loop: 连接所属的事件循环，为NULL时须由调用者调用flush结束一批
+      */
+    CWriteCoalescer(CEpollable* epollable, CEventLoop* event_loop=NULL, coalesce_policy_t policy=coalesce_cork);
+    ~CWriteCoalescer();
+
+    /** 修改策略，会先flush */
+    void set_policy(coalesce_policy_t policy);
+    coalesce_policy_t get_policy() const { return _policy; }
+
+    /** 连接换到另一个事件循环时调用，会先flush */
+    void set_event_loop(CEventLoop* event_loop);
+
+    /***
+      * 设置低延迟模式，设置为true时立即flush，之后不再合并，直到设置为false，
+      * 用于对延迟敏感的消息
+      */
+    void set_low_latency(bool low_latency);
+    bool is_low_latency() const { return _low_latency; }
+
+    /***
+      * 开始一批写，在批中可多次调用，
+      * 如果构造时指定了事件循环，则在其本轮事件和任务处理完后自动flush
+      * @exception: 设置TCP_CORK出错时抛出CSyscallException异常
+      */
+    void begin();
+
+    /** 得到批中send/sendmsg应带的标志，策略为coalesce_more时为MSG_MORE，否则为0 */
+    int get_send_flags() const;
+
+    /***
+      * 结束一批，攒着的不足一个报文的数据立即发出，
+      * 不在批中时什么也不做，不抛异常（连接可能已被对端关闭）
+      */
+    void flush();
+
+    /** 是否在批中 */
+    bool is_batching() const { return _batching; }
+
+    /** 得到flush的次数，即结束的批数 */
+    uint64_t get_flush_number() const { return _flush_number; }
+
+private:
+    friend class CEventLoop;
+    CEpollable* _epollable;
+    CEventLoop* _event_loop;
+    coalesce_policy_t _policy;
+    bool _low_latency;
+    bool _batching;
+    bool _flush_pending; /** 是否已在事件循环的待flush队列中 */
+    uint64_t _flush_number;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_WRITE_COALESCER_H
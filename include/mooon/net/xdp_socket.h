@@ -0,0 +1,169 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_XDP_SOCKET_H
+#define MOOON_NET_XDP_SOCKET_H
+#include "mooon/net/udp_socket.h"
+#include <string>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+/***
+  * AF_XDP套接字，收包不经过内核协议栈，不依赖libbpf和libxdp：
+  * 网卡的一个接收队列上的帧由XDP程序（见attach_program）直接放入与用户态共享的UMEM，
+  * 经共享的环形队列交给用户态，收一批包不需要系统调用（需要唤醒时才有一次）。
+  *
+  * 只接收IPv4（无选项、非分片）的UDP，receive_batch和CUdpSocket::receive_batch兼容，
+  * 解析以太网、IP和UDP首部后将载荷复制到CUdpMessageArena，帧随即归还给内核。
+  * 须有CAP_NET_ADMIN和CAP_BPF（或CAP_SYS_ADMIN）权限，不支持时create抛出异常，
+  * 通常通过CUdpIngress使用，它在不能使用AF_XDP时退回普通的UDP套接字。
+  *
+  * 非线程安全，一个接收队列一个实例，通常由一个绑定CPU的线程以忙轮询方式（见CEventLoop::set_busy_poll）读取。
+  */
+class CXdpSocket: public CEpollable
+{
+public:
+    CXdpSocket();
+    ~CXdpSocket();
+
+    /** 判断内核是否支持AF_XDP（不检查权限和网卡） */
+    static bool is_supported();
+
+    /***
+      * 创建套接字和UMEM并绑定到网卡的接收队列
+      * @ifname: 网卡名，如eth0
+      * @queue_id: 接收队列编号，须用ethtool的ntuple规则或RSS将要接收的流导向这个队列
+      * @frame_number: UMEM中帧的个数，为2的幂，接收环和填充环的大小与之相同
+      * @frame_size: 每帧的字节数，2048或4096
+      * @zero_copy: 是否要求零拷贝（须网卡驱动支持），为false时由内核选择，不支持零拷贝时为复制模式
+      * @exception: 出错抛出CSyscallException异常，不支持时errno为EAFNOSUPPORT
+      */
+    void create(const std::string& ifname, uint32_t queue_id=0, uint32_t frame_number=4096, uint32_t frame_size=2048, bool zero_copy=false);
+
+    /** 卸载XDP程序并释放套接字和UMEM，析构时自动调用 */
+    void destroy();
+
+    /***
+      * 在网卡上挂载XDP程序，将目的端口为ports之一的UDP包转到本套接字，其它的包照常交给内核协议栈，
+      * 程序随本对象的销毁而卸载，一个网卡同时只能挂载一个XDP程序，所以只支持一个接收队列
+      * @ports: 目的端口，主机字节序
+      * @skb_mode: 是否以通用模式（XDP_FLAGS_SKB_MODE）挂载，网卡驱动不支持XDP时使用，比驱动模式慢
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void attach_program(const std::vector<uint16_t>& ports, bool skb_mode=false);
+
+    /***
+      * 同CUdpSocket::receive_batch，但从不阻塞，
+      * 成功返回接收到的消息个数，没有数据时返回-1
+      */
+    int receive_batch(CUdpMessageArena* arena);
+
+    /** 得到是否为零拷贝模式 */
+    bool is_zero_copy() const { return _zero_copy; }
+
+    /** 得到因不是UDP、被截断等被丢弃的帧数 */
+    uint64_t get_dropped_number() const { return _dropped_number; }
+
+    /** 得到内核因接收环满或填充环空等丢弃的帧数（XDP_STATISTICS） */
+    uint64_t get_kernel_dropped_number() const;
+
+private:
+    // 生产者和消费者共享的环形队列
+    struct Ring
+    {
+        uint32_t* producer;
+        uint32_t* consumer;
+        uint32_t* flags;
+        void* descs;
+        uint32_t mask;
+        void* map;
+        size_t map_size;
+
+        Ring(): producer(NULL), consumer(NULL), flags(NULL), descs(NULL), mask(0), map(NULL), map_size(0) {}
+    };
+
+    void map_ring(Ring* ring, uint64_t offset, size_t desc_size, const void* ring_offsets);
+    void unmap_ring(Ring* ring);
+    void refill(const uint64_t* addrs, uint32_t number);
+
+private:
+    char* _umem;
+    size_t _umem_size;
+    uint32_t _frame_number;
+    uint32_t _frame_size;
+    uint32_t _queue_id;
+    int _ifindex;
+    bool _zero_copy;
+    Ring _rx_ring;
+    Ring _fill_ring;
+    Ring _completion_ring;
+    std::vector<uint64_t> _recycled; // 本批处理完待归还的帧
+    int _map_fd;
+    int _prog_fd;
+    int _link_fd;
+    uint64_t _dropped_number;
+};
+
+/***
+  * UDP接收入口，能用AF_XDP时以CXdpSocket接收指定端口的包，否则退回普通的UDP套接字，
+  * 两者的receive_batch都兼容CUdpSocket::receive_batch，调用者不必区分。
+  * 使用AF_XDP时普通套接字也保持监听，接收其它接收队列上（未被XDP转走）的包。
+  *
+  * 使用示例：
+  * mooon::net::CUdpIngress ingress;
+  * ingress.create("0.0.0.0", 8125, "eth0", 0);
+  * mooon::net::CUdpMessageArena arena(64, 2048);
+  * for (;;)
+  * {
+  *     const int number = ingress.receive_batch(&arena);
+  *     for (int i=0; i<number; ++i)
+  *         handle(arena.get_data(i), arena.get_size(i), arena.get_addr(i));
+  * }
+  */
+class CUdpIngress
+{
+public:
+    CUdpIngress();
+    ~CUdpIngress();
+
+    /***
+      * 监听ip和port，ifname不为空时尝试在其queue_id号接收队列上使用AF_XDP
+      * @return: 是否使用了AF_XDP
+      * @exception: 普通套接字监听出错时抛出CSyscallException异常，AF_XDP的错误只记录日志
+      */
+    bool create(const std::string& ip, uint16_t port, const std::string& ifname="", uint32_t queue_id=0, bool skb_mode=false);
+
+    /***
+      * 先从AF_XDP再从普通套接字接收，从不阻塞
+      * @return: 接收到的消息个数，都没有数据时返回-1
+      */
+    int receive_batch(CUdpMessageArena* arena);
+
+    /** 得到AF_XDP套接字，没有使用时为NULL */
+    CXdpSocket* get_xdp_socket() const { return _xdp_socket; }
+
+    /** 得到普通的UDP套接字，可将它加入Epoll */
+    CUdpSocket* get_udp_socket() const { return _udp_socket; }
+
+private:
+    CXdpSocket* _xdp_socket;
+    CUdpSocket* _udp_socket;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_XDP_SOCKET_H
@@ -22,9 +22,16 @@
 #define MOOON_NET_ZOOKEEPER_HELPER_H
 #include <mooon/net/config.h>
 #include <mooon/net/utils.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/utils.h>
+#include <mooon/utils/compressor.h>
 #include <mooon/utils/exception.h>
+#include <mooon/utils/hash_utils.h>
 #include <mooon/utils/string_utils.h>
+#include <map>
+#include <memory>
+#include <vector>
 
 #if MOOON_HAVE_ZOOKEEPER == 1
 #include <zookeeper/zookeeper.h>
@@ -211,6 +218,131 @@ NET_NAMESPACE_BEGIN
 //         printf("(%d/%zd)%s\n", n, zk_data.size(), zk_data.c_str());
 //     }
 // }
+
+// 本地缓存中的一个节点
+struct ZkCachedNode
+{
+    bool exists;          // 节点是否存在
+    bool with_children;   // 是否同时缓存子节点列表
+    std::string data;
+    struct Stat stat;
+    std::vector<std::string> children;
+
+    ZkCachedNode()
+        : exists(false), with_children(false)
+    {
+        memset(&stat, 0, sizeof(stat));
+    }
+};
+
+// 本地缓存的快照，生成后不再修改，
+// 节点有变化时生成新的快照替换旧的，持有快照的读者不受影响
+typedef std::map<std::string, ZkCachedNode> ZkCacheSnapshot;
+
+// 异步请求的结果
+struct ZkAsyncResult
+{
+    int errcode;                        // 请求的错误码，ZOK表示成功
+    int children_errcode;               // 只用于get_zk_data_batch的with_children，读取子节点列表的错误码
+    std::string path;                   // 请求的路径，async_create_node时为实际创建的路径（如顺序节点）
+    std::string data;                   // 节点的数据
+    struct Stat stat;
+    std::vector<std::string> children;  // 子节点列表
+
+    ZkAsyncResult()
+        : errcode(ZOK), children_errcode(ZOK)
+    {
+        memset(&stat, 0, sizeof(stat));
+    }
+};
+
+// 异步请求的完成回调，在zookeeper的回调线程中调用，
+// 不能阻塞，也不能调用同步的读写（会死锁），可以swap走result中的数据
+typedef void (*zk_completion_t)(ZkAsyncResult* result, void* context);
+
+// 等待一个异步请求的完成，
+// 须等请求完成后才能销毁（析构时会等待）
+class CZkFuture
+{
+public:
+    CZkFuture()
+        : _pending(false)
+    {
+    }
+
+    ~CZkFuture()
+    {
+        wait();
+    }
+
+    bool is_done() const
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        return !_pending;
+    }
+
+    void wait()
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        while (_pending)
+            _event.wait(_lock);
+    }
+
+    // 最多等待milliseconds毫秒，返回请求是否已完成
+    bool timed_wait(uint32_t milliseconds)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_pending)
+            (void)_event.timed_wait(_lock, milliseconds);
+        return !_pending;
+    }
+
+    // 等待完成后返回结果
+    ZkAsyncResult* get_result()
+    {
+        wait();
+        return &_result;
+    }
+
+public: // 仅局限于被CZookeeperHelper调用
+    void start()
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        _pending = true;
+    }
+
+    // 请求未能发出
+    void cancel()
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        _pending = false;
+        _event.broadcast();
+    }
+
+    static void on_completion(ZkAsyncResult* result, void* context)
+    {
+        CZkFuture* self = static_cast<CZkFuture*>(context);
+        sys::LockHelper<sys::CLock> lock_helper(self->_lock);
+        std::swap(self->_result.errcode, result->errcode);
+        self->_result.path.swap(result->path);
+        self->_result.data.swap(result->data);
+        self->_result.stat = result->stat;
+        self->_result.children.swap(result->children);
+        self->_pending = false;
+        self->_event.broadcast();
+    }
+
+private:
+    CZkFuture(const CZkFuture&);
+    CZkFuture& operator =(const CZkFuture&);
+
+private:
+    mutable sys::CLock _lock;
+    sys::CEvent _event;
+    bool _pending;
+    ZkAsyncResult _result;
+};
+
 class CZookeeperHelper
 {
 public:
@@ -371,12 +503,99 @@ public:
     // 出错抛异常CSyscallException和CException
     int store_data(const std::string& data_filepath, const std::string& zk_path, bool keep_watch=true);
 
+public:
+    // 异步接口，以zookeeper C客户端的zoo_a*实现，请求发出后立即返回，
+    // 完成时（包括失败，如会话断开）在zookeeper的回调线程中调用completion，或使future完成，
+    // 可以同时发出大量请求，N个节点的读取只需约一次往返的时间。
+    //
+    // 请求未能发出时抛异常CException，这时不会回调
+
+    // 异步读取节点的数据，keep_watch为true时设置watch（由on_zookeeper_event通知）
+    void async_get_zk_data(const std::string& zk_path, zk_completion_t completion, void* context, bool keep_watch=false) const;
+    void async_get_zk_data(const std::string& zk_path, CZkFuture* future, bool keep_watch=false) const;
+
+    // 异步设置节点的数据，完成时结果中的stat为设置后的状态
+    void async_set_zk_data(const std::string& zk_path, const std::string& zk_data, zk_completion_t completion, void* context, int version=-1);
+    void async_set_zk_data(const std::string& zk_path, const std::string& zk_data, CZkFuture* future, int version=-1);
+
+    // 异步创建节点，zk_path为完整路径（和create_node不同），flags和acl同create_node，
+    // 完成时结果中的path为实际创建的路径
+    void async_create_node(const std::string& zk_path, const std::string& zk_node_data, int flags, zk_completion_t completion, void* context, const struct ACL_vector *acl=NULL);
+    void async_create_node(const std::string& zk_path, const std::string& zk_node_data, int flags, CZkFuture* future, const struct ACL_vector *acl=NULL);
+
+    // 异步取得子节点列表
+    void async_get_children(const std::string& zk_path, zk_completion_t completion, void* context, bool keep_watch=false) const;
+    void async_get_children(const std::string& zk_path, CZkFuture* future, bool keep_watch=false) const;
+
+    // 并行读取多个节点（如服务发现时的大量临时节点），results和zk_paths一一对应，
+    // 单个节点的错误（如ZNONODE）记录在对应结果的errcode中，不抛异常，
+    // with_children为true时同时读取子节点列表（错误码为children_errcode），
+    // max_pending为同时未完成的请求个数上限，以免占用过多的内存和服务端的队列。
+    // 等待所有请求完成后返回，不能在zookeeper的回调中调用
+    //
+    // 返回成功读取数据的节点个数，请求未能发出时等已发出的完成后抛异常CException
+    int get_zk_data_batch(const std::vector<std::string>& zk_paths, std::vector<ZkAsyncResult>* results, bool with_children=false, int max_pending=256) const;
+
+public:
+    // 分块存储，用于超过节点大小上限（jute.maxbuffer，默认1MB）的数据，如大的配置和路由表：
+    // 数据（可压缩）被切成多块，存储在zk_path下名为“chunk-代-序号”的子节点中，
+    // zk_path本身存储描述（以“MOOONCHUNK/1”开头，包括代、块数、大小、压缩方式和校验值）。
+    //
+    // 写入时先创建新一代的块节点（读者还看不到），
+    // 再以一次zoo_multi原子地更新描述（带版本检查，并发写入时只有一个成功）并删除上一代的块，
+    // 因此读者要么读到完整的旧数据，要么读到完整的新数据。
+    // 整个zoo_multi请求也受jute.maxbuffer限制，所以块不放在zoo_multi中创建。
+    //
+    // chunk_size 每块的最大字节数，须小于jute.maxbuffer
+    // compression 压缩方式，压缩后的数据才被分块
+    //
+    // 出错抛异常CException，失败时已创建的新块被删除
+    void put_chunked_data(const std::string& zk_path, const std::string& data, int chunk_size=SIZE_512K, utils::compression_t compression=utils::compression_none);
+
+    // 读取put_chunked_data写入的数据，所有块以zoo_aget并行读取，
+    // 如果zk_path不是分块存储的（没有描述），则返回它本身的完整数据，
+    // 读取期间遇到新的写入（旧的块被删除）时自动重试，
+    // 它和get_subtree_data都等待异步请求完成，不能在zookeeper的回调（如on_zookeeper_event）中调用
+    //
+    // 返回数据的字节数，出错抛异常CException
+    int get_chunked_data(const std::string& zk_path, std::string* data);
+
+    // 以zoo_aget和zoo_aget_children并行地逐层读取整个子树（包括zk_path本身），
+    // 结果以完整路径为键存入nodes，分块存储的节点存入合并后的数据，它的块节点不单独出现
+    //
+    // 返回节点个数，出错抛异常CException
+    int get_subtree_data(const std::string& zk_path, std::map<std::string, std::string>* nodes);
+
+    // 数据是否为分块存储的描述
+    static bool is_chunked_manifest(const std::string& zk_data);
+
+public:
+    // 订阅节点，将节点的数据（with_children为true时还有子节点列表）缓存在本地，
+    // 之后由watch保持缓存和zookeeper一致，会话重建后自动重新订阅，
+    // 节点不存在也可订阅，节点被创建后缓存随之更新。
+    //
+    // 应在is_connected()返回true后调用
+    // 出错抛异常CException
+    void subscribe(const std::string& zk_path, bool with_children=false);
+
+    // 取消订阅，节点从缓存中删除
+    void unsubscribe(const std::string& zk_path);
+
+    // 从本地缓存读取，不访问zookeeper也不加锁，
+    // 如果未订阅或节点不存在返回false
+    bool get_cached_data(const std::string& zk_path, std::string* zk_data, struct Stat* stat=NULL) const;
+    bool get_cached_children(const std::string& zk_path, std::vector<std::string>* children) const;
+
+    // 取得整个缓存的快照，多次读取需要一致的视图时使用
+    std::shared_ptr<const ZkCacheSnapshot> get_cache_snapshot() const;
+
 public: // 仅局限于被zk_watcher()调用，其它情况均不应当调用
     void zookeeper_session_connected(const char* path);
     void zookeeper_session_connecting(const char* path);
     void zookeeper_session_expired(const char *path);
     void zookeeper_session_event(int state, const char *path);
     void zookeeper_event(int type, int state, const char *path);
+    void zookeeper_cache_event(int type, const char *path); // 仅被zk_cache_watcher()调用
 
 private:
     // zookeeper session连接成功事件
@@ -407,6 +626,30 @@ private:
     // path 触发事件的path，如：/tmp/a
     virtual void on_zookeeper_event(int type, int state, const char *path) {}
 
+    // 订阅的节点在本地缓存中被更新，
+    // 在zookeeper的回调线程中调用，此时get_cached_data已可读到新值
+    virtual void on_zookeeper_cache_changed(const char *path) {}
+
+private:
+    // 从zookeeper读取节点并重新设置watch，出错返回zookeeper的错误码
+    int load_cached_node(const std::string& zk_path, ZkCachedNode* node);
+    // 重新加载所有订阅的节点，用于会话重建后
+    void reload_cache();
+    void publish_cache(const std::shared_ptr<const ZkCacheSnapshot>& snapshot);
+
+private:
+    // 分块存储的描述，解析失败时返回false
+    struct ChunkedManifest;
+    static bool parse_chunked_manifest(const std::string& zk_data, ChunkedManifest* manifest);
+    static std::string get_chunk_name(uint64_t generation, uint32_t index);
+    // 删除块节点，忽略错误，用于写入失败后的清理
+    void delete_chunks(const std::string& zk_path, const std::vector<std::string>& chunk_names);
+
+private:
+    sys::CLock _cache_lock; // 串行化缓存的更新，读不需要
+    std::shared_ptr<const ZkCacheSnapshot> _cache_snapshot; // 只以std::atomic_load/std::atomic_store访问
+    volatile bool _cache_reload_pending; // 是否需要在连接成功后重新加载缓存
+
 private:
     const clientid_t* _zk_clientid;
     zhandle_t* _zk_handle; // zookeeper句柄
@@ -464,8 +707,20 @@ inline static void zk_watcher(zhandle_t *zh, int type, int state, const char *pa
     //(void)zoo_set_watcher(zh, zk_watcher);
 }
 
+// 本地缓存专用的watcher，和zk_watcher分开，以不干扰on_zookeeper_event
+inline static void zk_cache_watcher(zhandle_t *zh, int type, int state, const char *path, void *context)
+{
+    // 会话事件也会被投递给各watcher，由zk_watcher处理
+    if (type != ZOO_SESSION_EVENT)
+    {
+        CZookeeperHelper* self = static_cast<CZookeeperHelper*>(context);
+        self->zookeeper_cache_event(type, path);
+    }
+}
+
 inline CZookeeperHelper::CZookeeperHelper() throw ()
-    : _zk_clientid(NULL), _zk_handle(NULL),
+    : _cache_snapshot(new ZkCacheSnapshot), _cache_reload_pending(false),
+      _zk_clientid(NULL), _zk_handle(NULL),
       _expected_session_timeout_seconds(10),
       _physical_session_timeout_seconds(0),
       _start_connect_time(0)
@@ -560,6 +815,8 @@ inline void CZookeeperHelper::close_session()
 
 inline void CZookeeperHelper::recreate_session()
 {
+    // 新会话没有原来的watch，连接成功后重新加载缓存
+    _cache_reload_pending = true;
     close_session();
     _zk_handle = zookeeper_init(_zk_nodes.c_str(), zk_watcher, _expected_session_timeout_seconds, _zk_clientid, this, 0);
 
@@ -824,11 +1081,552 @@ inline int CZookeeperHelper::store_data(const std::string& data_filepath, const
     }
 }
 
+// 一个已发出的异步请求，完成回调后删除
+struct ZkAsyncRequest
+{
+    zk_completion_t completion;
+    void* context;
+    ZkAsyncResult result;
+};
+
+inline static void zk_finish_async_request(ZkAsyncRequest* request)
+{
+    (*request->completion)(&request->result, request->context);
+    delete request;
+}
+
+// zoo_aget的回调，value在回调返回后被释放
+inline static void zk_async_data_completion(int rc, const char* value, int value_len, const struct Stat* stat, const void* data)
+{
+    ZkAsyncRequest* request = static_cast<ZkAsyncRequest*>(const_cast<void*>(data));
+    request->result.errcode = rc;
+    if (ZOK == rc)
+    {
+        if ((value != NULL) && (value_len > 0))
+            request->result.data.assign(value, value_len);
+        if (stat != NULL)
+            request->result.stat = *stat;
+    }
+    zk_finish_async_request(request);
+}
+
+// zoo_aset的回调
+inline static void zk_async_stat_completion(int rc, const struct Stat* stat, const void* data)
+{
+    ZkAsyncRequest* request = static_cast<ZkAsyncRequest*>(const_cast<void*>(data));
+    request->result.errcode = rc;
+    if ((ZOK == rc) && (stat != NULL))
+        request->result.stat = *stat;
+    zk_finish_async_request(request);
+}
+
+// zoo_acreate的回调，value为实际创建的路径
+inline static void zk_async_string_completion(int rc, const char* value, const void* data)
+{
+    ZkAsyncRequest* request = static_cast<ZkAsyncRequest*>(const_cast<void*>(data));
+    request->result.errcode = rc;
+    if ((ZOK == rc) && (value != NULL))
+        request->result.path = value;
+    zk_finish_async_request(request);
+}
+
+// zoo_aget_children的回调
+inline static void zk_async_strings_completion(int rc, const struct String_vector* strings, const void* data)
+{
+    ZkAsyncRequest* request = static_cast<ZkAsyncRequest*>(const_cast<void*>(data));
+    request->result.errcode = rc;
+    if ((ZOK == rc) && (strings != NULL))
+    {
+        request->result.children.resize(strings->count);
+        for (int i=0; i<strings->count; ++i)
+            request->result.children[i] = strings->data[i];
+    }
+    zk_finish_async_request(request);
+}
+
+// 等待一批异步请求全部完成
+struct ZkAsyncWaiter
+{
+    sys::CLock lock;
+    sys::CEvent event;
+    int pending;
+
+    void done()
+    {
+        sys::LockHelper<sys::CLock> lock_helper(lock);
+        if (0 == --pending)
+            event.signal();
+    }
+};
+
+// get_zk_data_batch中一个节点的结果位置
+struct ZkBatchSlot
+{
+    ZkAsyncResult* result;
+    ZkAsyncWaiter* waiter;
+};
+
+inline static void zk_batch_data_completion(ZkAsyncResult* result, void* context)
+{
+    ZkBatchSlot* slot = static_cast<ZkBatchSlot*>(context);
+    slot->result->errcode = result->errcode;
+    slot->result->data.swap(result->data);
+    slot->result->stat = result->stat;
+    slot->waiter->done();
+}
+
+inline static void zk_batch_children_completion(ZkAsyncResult* result, void* context)
+{
+    ZkBatchSlot* slot = static_cast<ZkBatchSlot*>(context);
+    slot->result->children_errcode = result->errcode;
+    slot->result->children.swap(result->children);
+    slot->waiter->done();
+}
+
+inline static ZkAsyncRequest* zk_new_async_request(const std::string& zk_path, zk_completion_t completion, void* context)
+{
+    ZkAsyncRequest* request = new ZkAsyncRequest;
+    request->completion = completion;
+    request->context = context;
+    request->result.path = zk_path;
+    return request;
+}
+
+inline void CZookeeperHelper::async_get_zk_data(const std::string& zk_path, zk_completion_t completion, void* context, bool keep_watch) const
+{
+    ZkAsyncRequest* request = zk_new_async_request(zk_path, completion, context);
+    const int errcode = zoo_aget(_zk_handle, zk_path.c_str(), keep_watch? 1: 0, zk_async_data_completion, request);
+    if (errcode != ZOK)
+    {
+        delete request;
+        THROW_EXCEPTION(utils::CStringUtils::format_string("async get path://%s data failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+}
+
+inline void CZookeeperHelper::async_get_zk_data(const std::string& zk_path, CZkFuture* future, bool keep_watch) const
+{
+    future->start();
+    try
+    {
+        async_get_zk_data(zk_path, CZkFuture::on_completion, future, keep_watch);
+    }
+    catch (utils::CException& ex)
+    {
+        future->cancel();
+        throw;
+    }
+}
+
+inline void CZookeeperHelper::async_set_zk_data(const std::string& zk_path, const std::string& zk_data, zk_completion_t completion, void* context, int version)
+{
+    ZkAsyncRequest* request = zk_new_async_request(zk_path, completion, context);
+    const int errcode = zoo_aset(_zk_handle, zk_path.c_str(), zk_data.data(), static_cast<int>(zk_data.size()), version, zk_async_stat_completion, request);
+    if (errcode != ZOK)
+    {
+        delete request;
+        THROW_EXCEPTION(utils::CStringUtils::format_string("async set path://%s data failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+}
+
+inline void CZookeeperHelper::async_set_zk_data(const std::string& zk_path, const std::string& zk_data, CZkFuture* future, int version)
+{
+    future->start();
+    try
+    {
+        async_set_zk_data(zk_path, zk_data, CZkFuture::on_completion, future, version);
+    }
+    catch (utils::CException& ex)
+    {
+        future->cancel();
+        throw;
+    }
+}
+
+inline void CZookeeperHelper::async_create_node(const std::string& zk_path, const std::string& zk_node_data, int flags, zk_completion_t completion, void* context, const struct ACL_vector *acl)
+{
+    ZkAsyncRequest* request = zk_new_async_request(zk_path, completion, context);
+    const struct ACL_vector* acl_ = (NULL == acl)? &ZOO_OPEN_ACL_UNSAFE: acl;
+    const int errcode = zoo_acreate(_zk_handle, zk_path.c_str(), zk_node_data.data(), static_cast<int>(zk_node_data.size()), acl_, flags, zk_async_string_completion, request);
+    if (errcode != ZOK)
+    {
+        delete request;
+        THROW_EXCEPTION(utils::CStringUtils::format_string("async create path://%s failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+}
+
+inline void CZookeeperHelper::async_create_node(const std::string& zk_path, const std::string& zk_node_data, int flags, CZkFuture* future, const struct ACL_vector *acl)
+{
+    future->start();
+    try
+    {
+        async_create_node(zk_path, zk_node_data, flags, CZkFuture::on_completion, future, acl);
+    }
+    catch (utils::CException& ex)
+    {
+        future->cancel();
+        throw;
+    }
+}
+
+inline void CZookeeperHelper::async_get_children(const std::string& zk_path, zk_completion_t completion, void* context, bool keep_watch) const
+{
+    ZkAsyncRequest* request = zk_new_async_request(zk_path, completion, context);
+    const int errcode = zoo_aget_children(_zk_handle, zk_path.c_str(), keep_watch? 1: 0, zk_async_strings_completion, request);
+    if (errcode != ZOK)
+    {
+        delete request;
+        THROW_EXCEPTION(utils::CStringUtils::format_string("async get path://%s children failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+}
+
+inline void CZookeeperHelper::async_get_children(const std::string& zk_path, CZkFuture* future, bool keep_watch) const
+{
+    future->start();
+    try
+    {
+        async_get_children(zk_path, CZkFuture::on_completion, future, keep_watch);
+    }
+    catch (utils::CException& ex)
+    {
+        future->cancel();
+        throw;
+    }
+}
+
+inline int CZookeeperHelper::get_zk_data_batch(const std::vector<std::string>& zk_paths, std::vector<ZkAsyncResult>* results, bool with_children, int max_pending) const
+{
+    const std::vector<std::string>::size_type window = (max_pending < 1)? 1: static_cast<std::vector<std::string>::size_type>(max_pending);
+    std::vector<ZkBatchSlot> slots(zk_paths.size());
+    ZkAsyncWaiter waiter;
+    int succeeded = 0;
+
+    results->assign(zk_paths.size(), ZkAsyncResult());
+    for (std::vector<std::string>::size_type begin=0; begin<zk_paths.size(); begin+=window)
+    {
+        const std::vector<std::string>::size_type end = std::min(begin+window, zk_paths.size());
+        bool sent = true;
+        std::string errmsg;
+        int errcode = ZOK;
+
+        waiter.pending = 1; // 防止发送过程中被提前唤醒
+        for (std::vector<std::string>::size_type i=begin; sent && (i<end); ++i)
+        {
+            ZkBatchSlot& slot = slots[i];
+            slot.result = &(*results)[i];
+            slot.waiter = &waiter;
+            slot.result->path = zk_paths[i];
+
+            for (int k=0; k<(with_children? 2: 1); ++k)
+            {
+                {
+                    sys::LockHelper<sys::CLock> lock_helper(waiter.lock);
+                    ++waiter.pending;
+                }
+
+                try
+                {
+                    if (0 == k)
+                        async_get_zk_data(zk_paths[i], zk_batch_data_completion, &slot);
+                    else
+                        async_get_children(zk_paths[i], zk_batch_children_completion, &slot);
+                }
+                catch (utils::CException& ex)
+                {
+                    // 未发出的请求不会回调
+                    sys::LockHelper<sys::CLock> lock_helper(waiter.lock);
+                    --waiter.pending;
+                    errmsg = ex.str();
+                    errcode = ex.errcode();
+                    sent = false;
+                    break;
+                }
+            }
+        }
+
+        // 已发出的请求总会回调（会话断开时以错误码回调），须等它们完成后才能返回
+        {
+            sys::LockHelper<sys::CLock> lock_helper(waiter.lock);
+            --waiter.pending;
+            while (waiter.pending > 0)
+                waiter.event.wait(waiter.lock);
+        }
+        if (!sent)
+        {
+            THROW_EXCEPTION(errmsg, errcode);
+        }
+    }
+
+    for (std::vector<ZkAsyncResult>::size_type i=0; i<results->size(); ++i)
+    {
+        if (ZOK == (*results)[i].errcode)
+            ++succeeded;
+    }
+    return succeeded;
+}
+
+struct CZookeeperHelper::ChunkedManifest
+{
+    uint64_t generation;
+    uint32_t chunks;
+    uint64_t size;        // 原始数据的字节数
+    uint64_t stored_size; // 所有块的字节数之和（压缩后）
+    uint64_t xxhash;      // 所有块合并后的xxhash64
+    utils::compression_t compression;
+};
+
+inline bool CZookeeperHelper::is_chunked_manifest(const std::string& zk_data)
+{
+    return 0 == zk_data.compare(0, sizeof("MOOONCHUNK/1 ")-1, "MOOONCHUNK/1 ");
+}
+
+inline bool CZookeeperHelper::parse_chunked_manifest(const std::string& zk_data, ChunkedManifest* manifest)
+{
+    char compression_name[16];
+    unsigned long long generation, size, stored_size, xxhash;
+    unsigned int chunks;
+
+    if (!is_chunked_manifest(zk_data))
+        return false;
+    if (sscanf(zk_data.c_str(), "MOOONCHUNK/1 generation=%llu chunks=%u size=%llu stored=%llu compression=%15s xxhash64=%llx",
+               &generation, &chunks, &size, &stored_size, compression_name, &xxhash) != 6)
+        return false;
+
+    try
+    {
+        manifest->compression = utils::get_compression_by_name(compression_name);
+    }
+    catch (utils::CException& ex)
+    {
+        return false;
+    }
+
+    manifest->generation = generation;
+    manifest->chunks = chunks;
+    manifest->size = size;
+    manifest->stored_size = stored_size;
+    manifest->xxhash = xxhash;
+    return true;
+}
+
+inline std::string CZookeeperHelper::get_chunk_name(uint64_t generation, uint32_t index)
+{
+    return utils::CStringUtils::format_string("chunk-%" PRIu64"-%u", generation, index);
+}
+
+inline void CZookeeperHelper::delete_chunks(const std::string& zk_path, const std::vector<std::string>& chunk_names)
+{
+    for (std::vector<std::string>::size_type i=0; i<chunk_names.size(); ++i)
+        (void)zoo_delete(_zk_handle, (zk_path + "/" + chunk_names[i]).c_str(), -1);
+}
+
+inline void CZookeeperHelper::put_chunked_data(const std::string& zk_path, const std::string& data, int chunk_size, utils::compression_t compression)
+{
+    if ((chunk_size < 1) || (chunk_size >= SIZE_1M))
+    {
+        THROW_EXCEPTION(utils::CStringUtils::format_string("invalid chunk size: %d", chunk_size), EINVAL);
+    }
+
+    // 描述节点不存在时先创建，之后以它的版本号作为代，并用于zoo_multi中的版本检查
+    struct Stat stat;
+    int errcode = zoo_exists(_zk_handle, zk_path.c_str(), 0, &stat);
+    if (ZNONODE == errcode)
+    {
+        errcode = zoo_create(_zk_handle, zk_path.c_str(), NULL, -1, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+        if ((ZOK == errcode) || (ZNODEEXISTS == errcode))
+            errcode = zoo_exists(_zk_handle, zk_path.c_str(), 0, &stat);
+    }
+    if (errcode != ZOK)
+    {
+        THROW_EXCEPTION(utils::CStringUtils::format_string("stat path://%s failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+
+    // 上一代（以及之前失败残留）的块，在切换后删除
+    std::vector<std::string> children;
+    std::vector<std::string> old_chunk_names;
+    (void)get_all_children(&children, zk_path, false);
+    for (std::vector<std::string>::size_type i=0; i<children.size(); ++i)
+    {
+        if (0 == children[i].compare(0, sizeof("chunk-")-1, "chunk-"))
+            old_chunk_names.push_back(children[i]);
+    }
+
+    std::string stored;
+    if (compression != utils::compression_none)
+        utils::compress_data(compression, data.data(), data.size(), &stored);
+    const std::string& stored_data = (compression != utils::compression_none)? stored: data;
+
+    // 以描述节点的版本作为代，并发写入时代相同，只有一个能通过版本检查
+    ChunkedManifest manifest;
+    manifest.generation = static_cast<uint64_t>(stat.version) + 1;
+    manifest.chunks = static_cast<uint32_t>((stored_data.size() + chunk_size - 1) / chunk_size);
+    manifest.size = data.size();
+    manifest.stored_size = stored_data.size();
+    manifest.xxhash = utils::CHashUtils::xxhash64(stored_data.data(), stored_data.size());
+    manifest.compression = compression;
+
+    std::vector<std::string> new_chunk_names;
+    for (uint32_t i=0; i<manifest.chunks; ++i)
+    {
+        const std::string chunk_name = get_chunk_name(manifest.generation, i);
+        const std::string chunk_path = zk_path + "/" + chunk_name;
+        const std::string::size_type offset = static_cast<std::string::size_type>(i) * chunk_size;
+        const int length = static_cast<int>(std::min<std::string::size_type>(chunk_size, stored_data.size()-offset));
+
+        errcode = zoo_create(_zk_handle, chunk_path.c_str(), stored_data.data()+offset, length, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+        if (errcode != ZOK)
+        {
+            delete_chunks(zk_path, new_chunk_names);
+            THROW_EXCEPTION(utils::CStringUtils::format_string("create path://%s failed: %s", chunk_path.c_str(), zerror(errcode)), errcode);
+        }
+        new_chunk_names.push_back(chunk_name);
+    }
+
+    // 一次zoo_multi：更新描述（带版本检查）并删除旧的块
+    const std::string manifest_data = utils::CStringUtils::format_string(
+        "MOOONCHUNK/1 generation=%" PRIu64" chunks=%u size=%" PRIu64" stored=%" PRIu64" compression=%s xxhash64=%016" PRIx64,
+        manifest.generation, manifest.chunks, manifest.size, manifest.stored_size,
+        utils::get_compression_name(compression), manifest.xxhash);
+    std::vector<std::string> old_chunk_paths(old_chunk_names.size());
+    std::vector<zoo_op_t> ops(1 + old_chunk_names.size());
+    std::vector<zoo_op_result_t> results(ops.size());
+    struct Stat new_stat;
+
+    zoo_set_op_init(&ops[0], zk_path.c_str(), manifest_data.data(), static_cast<int>(manifest_data.size()), stat.version, &new_stat);
+    for (std::vector<std::string>::size_type i=0; i<old_chunk_names.size(); ++i)
+    {
+        old_chunk_paths[i] = zk_path + "/" + old_chunk_names[i];
+        zoo_delete_op_init(&ops[i+1], old_chunk_paths[i].c_str(), -1);
+    }
+
+    errcode = zoo_multi(_zk_handle, static_cast<int>(ops.size()), &ops[0], &results[0]);
+    if (errcode != ZOK)
+    {
+        delete_chunks(zk_path, new_chunk_names);
+        THROW_EXCEPTION(utils::CStringUtils::format_string("commit chunks of path://%s failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+}
+
+inline int CZookeeperHelper::get_chunked_data(const std::string& zk_path, std::string* data)
+{
+    // 读取期间被新的写入切换时，旧的块已被删除，重新读取描述
+    for (int retry=0; retry<3; ++retry)
+    {
+        std::vector<std::string> paths(1, zk_path);
+        std::vector<ZkAsyncResult> results;
+        ChunkedManifest manifest;
+
+        (void)get_zk_data_batch(paths, &results);
+        if (results[0].errcode != ZOK)
+        {
+            THROW_EXCEPTION(utils::CStringUtils::format_string("get path://%s data failed: %s", zk_path.c_str(), zerror(results[0].errcode)), results[0].errcode);
+        }
+        if (!is_chunked_manifest(results[0].data))
+        {
+            data->swap(results[0].data);
+            return static_cast<int>(data->size());
+        }
+        if (!parse_chunked_manifest(results[0].data, &manifest))
+        {
+            THROW_EXCEPTION(utils::CStringUtils::format_string("invalid chunk manifest of path://%s", zk_path.c_str()), EINVAL);
+        }
+
+        paths.resize(manifest.chunks);
+        for (uint32_t i=0; i<manifest.chunks; ++i)
+            paths[i] = zk_path + "/" + get_chunk_name(manifest.generation, i);
+        (void)get_zk_data_batch(paths, &results);
+
+        bool switched = false;
+        std::string stored;
+        stored.reserve(static_cast<std::string::size_type>(manifest.stored_size));
+        for (uint32_t i=0; i<manifest.chunks; ++i)
+        {
+            if (ZNONODE == results[i].errcode)
+            {
+                switched = true;
+                break;
+            }
+            if (results[i].errcode != ZOK)
+            {
+                THROW_EXCEPTION(utils::CStringUtils::format_string("get path://%s data failed: %s", paths[i].c_str(), zerror(results[i].errcode)), results[i].errcode);
+            }
+            stored.append(results[i].data);
+        }
+        if (switched)
+            continue;
+
+        if ((stored.size() != manifest.stored_size) || (utils::CHashUtils::xxhash64(stored.data(), stored.size()) != manifest.xxhash))
+        {
+            THROW_EXCEPTION(utils::CStringUtils::format_string("chunks of path://%s corrupted", zk_path.c_str()), EINVAL);
+        }
+        if (utils::compression_none == manifest.compression)
+        {
+            data->swap(stored);
+        }
+        else
+        {
+            data->clear();
+            utils::decompress_data(manifest.compression, stored.data(), stored.size(), data);
+        }
+        if (data->size() != manifest.size)
+        {
+            THROW_EXCEPTION(utils::CStringUtils::format_string("size of path://%s mismatch", zk_path.c_str()), EINVAL);
+        }
+
+        return static_cast<int>(data->size());
+    }
+
+    THROW_EXCEPTION(utils::CStringUtils::format_string("get chunks of path://%s failed: too many concurrent updates", zk_path.c_str()), EAGAIN);
+}
+
+inline int CZookeeperHelper::get_subtree_data(const std::string& zk_path, std::map<std::string, std::string>* nodes)
+{
+    std::vector<std::string> level(1, zk_path);
+
+    for (bool root=true; !level.empty(); root=false)
+    {
+        std::vector<std::string> next_level;
+        std::vector<ZkAsyncResult> results;
+
+        (void)get_zk_data_batch(level, &results, true);
+        for (std::vector<std::string>::size_type i=0; i<level.size(); ++i)
+        {
+            const ZkAsyncResult& result = results[i];
+
+            // 读取期间被删除的忽略，但根节点须存在
+            if ((ZNONODE == result.errcode) && !root)
+                continue;
+            if (result.errcode != ZOK)
+            {
+                THROW_EXCEPTION(utils::CStringUtils::format_string("get path://%s data failed: %s", level[i].c_str(), zerror(result.errcode)), result.errcode);
+            }
+
+            // 分块存储的节点整体读取，不再遍历它的块
+            if (is_chunked_manifest(result.data))
+            {
+                (void)get_chunked_data(level[i], &(*nodes)[level[i]]);
+                continue;
+            }
+
+            (*nodes)[level[i]] = result.data;
+            if (result.children_errcode != ZOK)
+                continue;
+            for (std::vector<std::string>::size_type j=0; j<result.children.size(); ++j)
+                next_level.push_back(("/" == level[i])? ("/" + result.children[j]): (level[i] + "/" + result.children[j]));
+        }
+
+        level.swap(next_level);
+    }
+
+    return static_cast<int>(nodes->size());
+}
+
 inline void CZookeeperHelper::zookeeper_session_connected(const char* path)
 {
     _zk_clientid = zoo_client_id(_zk_handle);
     _physical_session_timeout_seconds = get_session_timeout_milliseconds();
     _start_connect_time = 0;
+    if (_cache_reload_pending)
+        reload_cache();
     this->on_zookeeper_session_connected(path);
 }
 
@@ -840,6 +1638,7 @@ inline void CZookeeperHelper::zookeeper_session_connecting(const char* path)
 
 inline void CZookeeperHelper::zookeeper_session_expired(const char* path)
 {
+    _cache_reload_pending = true;
     this->on_zookeeper_session_expired(path);
 }
 
@@ -853,6 +1652,178 @@ inline void CZookeeperHelper::zookeeper_event(int type, int state, const char *p
     this->on_zookeeper_event(type, state, path);
 }
 
+inline void CZookeeperHelper::zookeeper_cache_event(int type, const char *path)
+{
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_cache_lock);
+        const std::shared_ptr<const ZkCacheSnapshot> snapshot = std::atomic_load(&_cache_snapshot);
+        ZkCacheSnapshot::const_iterator iter = snapshot->find(path);
+        if (iter == snapshot->end())
+            return; // 已取消订阅
+
+        // ZOO_CREATED_EVENT、ZOO_DELETED_EVENT、ZOO_CHANGED_EVENT和ZOO_CHILD_EVENT均重新读取，
+        // watch是一次性的，读取的同时重新设置
+        ZkCachedNode node;
+        node.with_children = iter->second.with_children;
+        if (load_cached_node(path, &node) != ZOK)
+        {
+            // 多为连接断开，会话恢复时zookeeper会补发事件，会话重建时则整体重新加载
+            _cache_reload_pending = true;
+            return;
+        }
+
+        std::shared_ptr<ZkCacheSnapshot> new_snapshot(new ZkCacheSnapshot(*snapshot));
+        (*new_snapshot)[path] = node;
+        publish_cache(new_snapshot);
+    }
+
+    this->on_zookeeper_cache_changed(path);
+}
+
+inline void CZookeeperHelper::subscribe(const std::string& zk_path, bool with_children)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_cache_lock);
+    ZkCachedNode node;
+    node.with_children = with_children;
+    const int errcode = load_cached_node(zk_path, &node);
+    if (errcode != ZOK)
+    {
+        THROW_EXCEPTION(utils::CStringUtils::format_string("subscribe path://%s failed: %s", zk_path.c_str(), zerror(errcode)), errcode);
+    }
+
+    std::shared_ptr<ZkCacheSnapshot> new_snapshot(new ZkCacheSnapshot(*std::atomic_load(&_cache_snapshot)));
+    (*new_snapshot)[zk_path] = node;
+    publish_cache(new_snapshot);
+}
+
+inline void CZookeeperHelper::unsubscribe(const std::string& zk_path)
+{
+    // zookeeper不能取消已设置的watch，之后触发时因找不到而忽略
+    sys::LockHelper<sys::CLock> lock_helper(_cache_lock);
+    std::shared_ptr<ZkCacheSnapshot> new_snapshot(new ZkCacheSnapshot(*std::atomic_load(&_cache_snapshot)));
+    if (new_snapshot->erase(zk_path) > 0)
+        publish_cache(new_snapshot);
+}
+
+inline bool CZookeeperHelper::get_cached_data(const std::string& zk_path, std::string* zk_data, struct Stat* stat) const
+{
+    const std::shared_ptr<const ZkCacheSnapshot> snapshot = std::atomic_load(&_cache_snapshot);
+    ZkCacheSnapshot::const_iterator iter = snapshot->find(zk_path);
+    if ((iter == snapshot->end()) || !iter->second.exists)
+        return false;
+
+    *zk_data = iter->second.data;
+    if (stat != NULL)
+        *stat = iter->second.stat;
+    return true;
+}
+
+inline bool CZookeeperHelper::get_cached_children(const std::string& zk_path, std::vector<std::string>* children) const
+{
+    const std::shared_ptr<const ZkCacheSnapshot> snapshot = std::atomic_load(&_cache_snapshot);
+    ZkCacheSnapshot::const_iterator iter = snapshot->find(zk_path);
+    if ((iter == snapshot->end()) || !iter->second.exists || !iter->second.with_children)
+        return false;
+
+    *children = iter->second.children;
+    return true;
+}
+
+inline std::shared_ptr<const ZkCacheSnapshot> CZookeeperHelper::get_cache_snapshot() const
+{
+    return std::atomic_load(&_cache_snapshot);
+}
+
+inline int CZookeeperHelper::load_cached_node(const std::string& zk_path, ZkCachedNode* node)
+{
+    for (;;)
+    {
+        int datalen = (node->data.size() < SIZE_4K)? SIZE_4K: static_cast<int>(node->data.size());
+        node->data.resize(datalen);
+        int errcode = zoo_wget(_zk_handle, zk_path.c_str(), zk_cache_watcher, this, const_cast<char*>(node->data.data()), &datalen, &node->stat);
+        if (ZNONODE == errcode)
+        {
+            // 以exists设置watch，节点被创建时得到通知，
+            // 如果恰好在两次调用之间被创建，则重新读取
+            errcode = zoo_wexists(_zk_handle, zk_path.c_str(), zk_cache_watcher, this, &node->stat);
+            if (ZOK == errcode)
+                continue;
+            if (errcode != ZNONODE)
+                return errcode;
+
+            node->exists = false;
+            node->data.clear();
+            node->children.clear();
+            memset(&node->stat, 0, sizeof(node->stat));
+            return ZOK;
+        }
+        if (errcode != ZOK)
+            return errcode;
+        if (node->stat.dataLength > static_cast<int>(node->data.size()))
+        {
+            // 缓冲区不够，按实际大小重新读取
+            node->data.resize(node->stat.dataLength);
+            continue;
+        }
+
+        node->exists = true;
+        node->data.resize((datalen < 0)? 0: datalen);
+        if (node->with_children)
+        {
+            struct String_vector strings;
+            errcode = zoo_wget_children(_zk_handle, zk_path.c_str(), zk_cache_watcher, this, &strings);
+            if (ZNONODE == errcode)
+                continue; // 在两次调用之间被删除
+            if (errcode != ZOK)
+                return errcode;
+
+            node->children.resize(strings.count);
+            for (int i=0; i<strings.count; ++i)
+                node->children[i] = strings.data[i];
+            deallocate_String_vector(&strings);
+        }
+
+        return ZOK;
+    }
+}
+
+inline void CZookeeperHelper::reload_cache()
+{
+    std::vector<std::string> reloaded_paths;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_cache_lock);
+        const std::shared_ptr<const ZkCacheSnapshot> snapshot = std::atomic_load(&_cache_snapshot);
+        std::shared_ptr<ZkCacheSnapshot> new_snapshot(new ZkCacheSnapshot(*snapshot));
+
+        _cache_reload_pending = false;
+        for (ZkCacheSnapshot::iterator iter=new_snapshot->begin(); iter!=new_snapshot->end(); ++iter)
+        {
+            // 失败的保留原值，等待下一次重新加载
+            ZkCachedNode node;
+            node.with_children = iter->second.with_children;
+            if (load_cached_node(iter->first, &node) != ZOK)
+            {
+                _cache_reload_pending = true;
+            }
+            else
+            {
+                iter->second = node;
+                reloaded_paths.push_back(iter->first);
+            }
+        }
+
+        publish_cache(new_snapshot);
+    }
+
+    for (std::vector<std::string>::size_type i=0; i<reloaded_paths.size(); ++i)
+        this->on_zookeeper_cache_changed(reloaded_paths[i].c_str());
+}
+
+inline void CZookeeperHelper::publish_cache(const std::shared_ptr<const ZkCacheSnapshot>& snapshot)
+{
+    std::atomic_store(&_cache_snapshot, snapshot);
+}
+
 #endif // MOOON_HAVE_ZOOKEEPER == 1
 NET_NAMESPACE_END
 #endif // MOOON_NET_ZOOKEEPER_HELPER_H
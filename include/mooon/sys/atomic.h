@@ -16,8 +16,44 @@
 #if __cplusplus >= 201103L
 #include <atomic>
 #endif // __cplusplus >= 201103L
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 SYS_NAMESPACE_BEGIN
+
+/***
+  * 内存序，值同GCC的__ATOMIC_*和std::memory_order，
+  * 不指定时为atomic_seq_cst（全屏障），统计计数一类不需要同步其它数据的用atomic_relaxed，
+  * 发布数据用atomic_release写、atomic_acquire读，需要GCC 4.7或以上版本
+  */
+typedef enum
+{
+    atomic_relaxed = __ATOMIC_RELAXED,
+    atomic_acquire = __ATOMIC_ACQUIRE,
+    atomic_release = __ATOMIC_RELEASE,
+    atomic_acq_rel = __ATOMIC_ACQ_REL,
+    atomic_seq_cst = __ATOMIC_SEQ_CST
+}atomic_order_t;
+
+/** CAS失败时的内存序，不能含release */
+inline int get_atomic_failure_order(atomic_order_t order)
+{
+    if (atomic_release == order)
+        return __ATOMIC_RELAXED;
+    if (atomic_acq_rel == order)
+        return __ATOMIC_ACQUIRE;
+    return order;
+}
+
+#if __cplusplus >= 201103L
+inline std::memory_order to_memory_order(atomic_order_t order)
+{
+    return static_cast<std::memory_order>(order);
+}
+#endif // __cplusplus >= 201103L
+
 template <typename T>
 class CAtomic
 {
@@ -27,7 +63,7 @@ template <>
 class CAtomic<bool>
 {
 public:
-    CAtomic<bool>()
+    CAtomic()
     {
 #if __cplusplus < 201103L
         atomic_set(&_value, 0);
@@ -36,7 +72,7 @@ public:
 #endif // __cplusplus < 201103L
     }
 
-    CAtomic<bool>(bool value)
+    CAtomic(bool value)
     {
 #if __cplusplus < 201103L
         if (value)
@@ -48,7 +84,7 @@ public:
 #endif
     }
 
-    CAtomic<bool>(const CAtomic<bool>& other)
+    CAtomic(const CAtomic<bool>& other)
     {
 #if __cplusplus < 201103L
         const int v = other.get_value();
@@ -119,7 +155,7 @@ template <>
 class CAtomic<int>
 {
 public:
-    CAtomic<int>()
+    CAtomic()
     {
 #if __cplusplus < 201103L
         atomic_set(&_value, 0);
@@ -128,7 +164,7 @@ public:
 #endif
     }
 
-    CAtomic<int>(int value)
+    CAtomic(int value)
     {
 #if __cplusplus < 201103L
         atomic_set(&_value, value);
@@ -137,7 +173,7 @@ public:
 #endif
     }
 
-    CAtomic<int>(const CAtomic<int>& other)
+    CAtomic(const CAtomic<int>& other)
     {
 #if __cplusplus < 201103L
         const int v = other.get_value();
@@ -252,6 +288,61 @@ public:
         return *this;
     }
 
+    /** 以指定的内存序读 */
+    int load(atomic_order_t order=atomic_seq_cst) const
+    {
+#if __cplusplus < 201103L
+        return __atomic_load_n(&_value, order);
+#else
+        return _value.load(to_memory_order(order));
+#endif
+    }
+
+    /** 以指定的内存序写 */
+    void store(int value, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        __atomic_store_n(&_value, value, order);
+#else
+        _value.store(value, to_memory_order(order));
+#endif
+    }
+
+    /** 返回加之前的值 */
+    int fetch_add(int value, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        return __atomic_fetch_add(&_value, value, order);
+#else
+        return _value.fetch_add(value, to_memory_order(order));
+#endif
+    }
+
+    /** 返回减之前的值 */
+    int fetch_sub(int value, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        return __atomic_fetch_sub(&_value, value, order);
+#else
+        return _value.fetch_sub(value, to_memory_order(order));
+#endif
+    }
+
+    /***
+      * 如果当前值等于expected则改为desired并返回true，否则将expected更新为当前值并返回false
+      */
+    bool compare_exchange(int& expected, int desired, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        int current = expected;
+        const bool exchanged = __atomic_compare_exchange_n(&_value, &current, desired, false, order, get_atomic_failure_order(order));
+        expected = current;
+        return exchanged;
+#else
+        return _value.compare_exchange_strong(expected, desired, to_memory_order(order));
+#endif
+    }
+
 private:
 #if __cplusplus < 201103L
     atomic_t _value;
@@ -265,7 +356,7 @@ template <>
 class CAtomic<int64_t>
 {
 public:
-    CAtomic<int64_t>()
+    CAtomic()
     {
 #if __cplusplus < 201103L
         atomic8_set(&_value, 0);
@@ -274,7 +365,7 @@ public:
 #endif
     }
 
-    CAtomic<int64_t>(int64_t value)
+    CAtomic(int64_t value)
     {
 #if __cplusplus < 201103L
         atomic8_set(&_value, value);
@@ -283,7 +374,7 @@ public:
 #endif
     }
 
-    CAtomic<int64_t>(const CAtomic<int64_t>& other)
+    CAtomic(const CAtomic<int64_t>& other)
     {
 #if __cplusplus < 201103L
         const int64_t v = other.get_value();
@@ -398,6 +489,61 @@ public:
         return *this;
     }
 
+    /** 以指定的内存序读 */
+    int64_t load(atomic_order_t order=atomic_seq_cst) const
+    {
+#if __cplusplus < 201103L
+        return __atomic_load_n(&_value, order);
+#else
+        return _value.load(to_memory_order(order));
+#endif
+    }
+
+    /** 以指定的内存序写 */
+    void store(int64_t value, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        __atomic_store_n(&_value, value, order);
+#else
+        _value.store(value, to_memory_order(order));
+#endif
+    }
+
+    /** 返回加之前的值 */
+    int64_t fetch_add(int64_t value, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        return __atomic_fetch_add(&_value, value, order);
+#else
+        return _value.fetch_add(value, to_memory_order(order));
+#endif
+    }
+
+    /** 返回减之前的值 */
+    int64_t fetch_sub(int64_t value, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        return __atomic_fetch_sub(&_value, value, order);
+#else
+        return _value.fetch_sub(value, to_memory_order(order));
+#endif
+    }
+
+    /***
+      * 如果当前值等于expected则改为desired并返回true，否则将expected更新为当前值并返回false
+      */
+    bool compare_exchange(int64_t& expected, int64_t desired, atomic_order_t order=atomic_seq_cst)
+    {
+#if __cplusplus < 201103L
+        long current = expected;
+        const bool exchanged = __atomic_compare_exchange_n(&_value, &current, desired, false, order, get_atomic_failure_order(order));
+        expected = current;
+        return exchanged;
+#else
+        return _value.compare_exchange_strong(expected, desired, to_memory_order(order));
+#endif
+    }
+
 private:
 #if __cplusplus < 201103L
     atomic8_t _value;
@@ -407,5 +553,72 @@ private:
 };
 #endif // __WORDSIZE==64
 
+/***
+  * 独占缓存行的值，用于放在数组或结构中的、被不同线程频繁修改的计数，避免伪共享
+  */
+template <typename T>
+struct CCacheLinePadded
+{
+    T value;
+    char pad[(sizeof(T) % CACHE_LINE_SIZE == 0)? CACHE_LINE_SIZE: CACHE_LINE_SIZE - sizeof(T) % CACHE_LINE_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/***
+  * 按CPU分片的计数器，每个分片独占一个缓存行，add按当前CPU（sched_getcpu）选择分片，
+  * 以relaxed原子操作更新，不同CPU上的线程互不竞争同一缓存行，get汇总所有分片，读到的是近似值。
+  * 和CCounter（metrics.h）不同，它不注册到CMetricsRegistry，适合作为类的成员（如池的统计）。
+  */
+class CPerCpuCounter
+{
+public:
+    CPerCpuCounter()
+    {
+        const long cpu_number = sysconf(_SC_NPROCESSORS_CONF);
+        uint32_t number = 1;
+        while (number < static_cast<uint32_t>((cpu_number > 0)? cpu_number: 1))
+            number <<= 1;
+
+        void* memory = NULL;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(CCacheLinePadded<uint64_t>) * number) != 0)
+            abort();
+        memset(memory, 0, sizeof(CCacheLinePadded<uint64_t>) * number);
+        _slots = static_cast<CCacheLinePadded<uint64_t>*>(memory);
+        _slot_mask = number - 1;
+    }
+
+    ~CPerCpuCounter()
+    {
+        free(_slots);
+    }
+
+    void add(uint64_t value=1)
+    {
+        const int cpu = sched_getcpu();
+        __atomic_fetch_add(&_slots[static_cast<uint32_t>((cpu < 0)? 0: cpu) & _slot_mask].value, value, __ATOMIC_RELAXED);
+    }
+
+    uint64_t get() const
+    {
+        uint64_t value = 0;
+        for (uint32_t i=0; i<=_slot_mask; ++i)
+            value += __atomic_load_n(&_slots[i].value, __ATOMIC_RELAXED);
+        return value;
+    }
+
+    void reset()
+    {
+        for (uint32_t i=0; i<=_slot_mask; ++i)
+            __atomic_store_n(&_slots[i].value, 0, __ATOMIC_RELAXED);
+    }
+
+private:
+    CPerCpuCounter(const CPerCpuCounter&);
+    CPerCpuCounter& operator =(const CPerCpuCounter&);
+
+private:
+    CCacheLinePadded<uint64_t>* _slots;
+    uint32_t _slot_mask;
+};
+
 SYS_NAMESPACE_END
 #endif /* __ATOMIC_H__ */
@@ -0,0 +1,140 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_ATOMIC128_H
+#define MOOON_SYS_ATOMIC128_H
+#include "mooon/sys/config.h"
+#include <stdint.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 16字节对齐的128位值，用于双字CAS，如指针加版本号（tagged pointer）
+  */
+struct atomic128_t
+{
+    uint64_t low;
+    uint64_t high;
+} __attribute__((aligned(16)));
+
+/***
+  * 128位CAS，总是全屏障
+  * 如果*target等于*expected则改为desired并返回true，否则将*expected更新为*target并返回false
+  *
+  * x86_64上直接使用lock cmpxchg16b，不需要-mcx16编译选项，也不依赖libatomic，
+  * 其它平台使用__atomic内置函数，可能需要链接libatomic（这时不一定无锁）。
+  */
+inline bool atomic_cas128(atomic128_t* target, atomic128_t* expected, const atomic128_t& desired)
+{
+#if defined(__x86_64__)
+    bool exchanged;
+    __asm__ __volatile__(
+        "lock cmpxchg16b %1\n\t"
+        "sete %0"
+        : "=q"(exchanged), "+m"(*target), "+a"(expected->low), "+d"(expected->high)
+        : "b"(desired.low), "c"(desired.high)
+        : "cc", "memory");
+    return exchanged;
+#else
+    unsigned __int128 current = (static_cast<unsigned __int128>(expected->high) << 64) | expected->low;
+    const unsigned __int128 value = (static_cast<unsigned __int128>(desired.high) << 64) | desired.low;
+    const bool exchanged = __atomic_compare_exchange_n(reinterpret_cast<unsigned __int128*>(target), &current, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    expected->low = static_cast<uint64_t>(current);
+    expected->high = static_cast<uint64_t>(current >> 64);
+    return exchanged;
+#endif // __x86_64__
+}
+
+/***
+  * 原子地读128位值
+  * x86_64上没有128位的原子读，以期望值和新值相同的CAS实现，需要target可写，
+  * 因此比普通的读慢得多，且会独占缓存行，能用CAS失败时返回的当前值的地方不必再读
+  */
+inline atomic128_t atomic_load128(atomic128_t* target)
+{
+    atomic128_t value = { 0, 0 };
+    (void)atomic_cas128(target, &value, value);
+    return value;
+}
+
+/***
+  * 带版本号的原子指针，每次修改时版本号增一，用于无锁栈和空闲链表等避免ABA问题：
+  * 一个线程读到栈顶A后被切换走，其它线程弹出A、B后又压回A，
+  * 只比较指针的CAS会误以为栈顶没变，而版本号已经不同，CAS失败。
+  * 版本号只解决ABA，不解决内存回收，弹出的节点仍可能正被其它线程读，不能立即释放（如应来自对象池）。
+  *
+  * 使用示例（无锁栈的pop）：
+  * mooon::sys::CTaggedPointer<Node>::tagged_t top = stack_top.load();
+  * while ((top.pointer != NULL) && !stack_top.compare_exchange(top, top.pointer->next));
+  */
+template <typename T>
+class CTaggedPointer
+{
+public:
+    struct tagged_t
+    {
+        T* pointer;
+        uint64_t tag;
+    };
+
+public:
+    CTaggedPointer(T* pointer=NULL)
+    {
+        _value.low = reinterpret_cast<uintptr_t>(pointer);
+        _value.high = 0;
+    }
+
+    /** 以CAS读，见atomic_load128 */
+    tagged_t load()
+    {
+        return to_tagged(atomic_load128(&_value));
+    }
+
+    /***
+      * 如果当前的指针和版本号都等于expected，则改为desired且版本号增一并返回true，
+      * 否则将expected更新为当前值并返回false，可直接用于重试
+      */
+    bool compare_exchange(tagged_t& expected, T* desired)
+    {
+        atomic128_t current;
+        atomic128_t value;
+        current.low = reinterpret_cast<uintptr_t>(expected.pointer);
+        current.high = expected.tag;
+        value.low = reinterpret_cast<uintptr_t>(desired);
+        value.high = expected.tag + 1;
+
+        const bool exchanged = atomic_cas128(&_value, &current, value);
+        if (!exchanged)
+            expected = to_tagged(current);
+        return exchanged;
+    }
+
+private:
+    static tagged_t to_tagged(const atomic128_t& value)
+    {
+        tagged_t tagged;
+        tagged.pointer = reinterpret_cast<T*>(value.low);
+        tagged.tag = value.high;
+        return tagged;
+    }
+
+private:
+    atomic128_t _value;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_ATOMIC128_H
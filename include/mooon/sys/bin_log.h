@@ -0,0 +1,186 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_BIN_LOG_H
+#define MOOON_SYS_BIN_LOG_H
+#include "mooon/sys/log.h"
+#include <stdio.h>
+#include <map>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 结构化二进制日志
+  * 写日志时不做格式化，只记录格式ID、时间戳、线程ID和参数的原始字节，
+  * 格式串在每个调用点只注册一次，日志线程在日志文件中先写格式定义记录，再写引用它的日志记录，
+  * 由离线工具（tools/bin_log_decoder）在读取时才格式化成文本。
+  *
+  * 使用方法：
+  * 1) 调用CLogger::enable_binary_format(true)后再调用create
+  * 2) 使用MYLOG_STRUCT_DEBUG等宏写日志，用法和MYLOG_DEBUG等相同
+  * 未开启二进制格式的日志器，MYLOG_STRUCT_*等同于普通的文本日志
+  */
+
+enum
+{
+    BIN_LOG_MAGIC          = 0xB10C, /** 每条记录的魔数 */
+    BIN_LOG_RECORD_FORMAT  = 1,      /** 格式定义记录 */
+    BIN_LOG_RECORD_LOG     = 2,      /** 日志记录 */
+    BIN_LOG_TEXT_FORMAT_ID = 0,      /** 保留的格式ID，表示记录内容为已格式化的文本 */
+    BIN_LOG_FORMAT_MAX     = 65536   /** 最多可注册的格式个数 */
+};
+
+/***
+  * 每条记录的头部，记录内容紧随其后，
+  * 格式定义记录的内容为：4字节行号、以'\0'结尾的文件名和以'\0'结尾的格式串，
+  * 日志记录的内容为按格式串顺序排列的参数：
+  * 整数为4或8字节，浮点数为8字节，指针为8字节，字符串为2字节长度加内容（不含结尾符）
+  */
+typedef struct
+{
+    uint16_t magic;      /** BIN_LOG_MAGIC */
+    uint8_t type;        /** BIN_LOG_RECORD_FORMAT或BIN_LOG_RECORD_LOG */
+    uint8_t log_level;   /** 日志级别 */
+    uint32_t length;     /** 整条记录的字节数，包括头部 */
+    uint32_t format_id;  /** 格式ID */
+    uint32_t thread_id;  /** 写日志的线程ID */
+    uint64_t timestamp;  /** 微秒时间戳 */
+}bin_log_header_t;
+
+/***
+  * 注册的格式
+  * arg_types中每个字符对应一个参数：
+  * 'i'为4字节整数，'I'为8字节整数，'d'为double，'D'为long double（按double存储），'s'为字符串，'p'为指针
+  */
+typedef struct
+{
+    log_level_t log_level;
+    int lineno;
+    std::string filename;
+    std::string format;
+    std::string arg_types;
+    bool supported;  /** 为false时格式中含有不支持的转换（如%n和%ls），只能在写日志时格式化 */
+}bin_log_format_t;
+
+/***
+  * 注册格式，可被多个线程同时调用，通常通过MYLOG_STRUCT_*宏在每个调用点只调用一次
+  * @return: 格式ID，如果注册的个数超过BIN_LOG_FORMAT_MAX，则返回BIN_LOG_TEXT_FORMAT_ID
+  */
+extern uint32_t register_bin_log_format(log_level_t log_level, const char* filename, int lineno, const char* format);
+
+/** 根据格式ID得到注册的格式，如果不存在返回NULL */
+extern const bin_log_format_t* get_bin_log_format(uint32_t format_id);
+
+/** 得到已注册的格式个数（包括保留的0号），即下一个格式ID */
+extern uint32_t get_bin_log_format_number();
+
+/***
+  * 解析printf风格的格式串，得到各参数的类型
+  * @return: 如果含有不支持的转换，则返回false
+  */
+extern bool parse_bin_log_format(const char* format, std::string* arg_types);
+
+/** 填写记录头，时间戳和线程ID取当前的 */
+extern void fill_bin_log_header(bin_log_header_t* header, uint8_t type, log_level_t log_level, uint32_t format_id, uint32_t length);
+
+/***
+  * 将参数编码成一条日志记录，字符串放不下时被截断
+  * @buffer: 存放记录的缓冲区，包括头部
+  * @return: 记录的字节数
+  */
+extern uint32_t encode_bin_log(char* buffer, uint32_t buffer_size, uint32_t format_id, const bin_log_format_t& bin_log_format, va_list& args);
+
+/** 将格式编码成一条格式定义记录，追加到record */
+extern void encode_bin_log_format(std::string* record, uint32_t format_id, const bin_log_format_t& bin_log_format);
+
+/***
+  * 二进制日志文件读取器，用于离线解码
+  */
+class CBinLogReader
+{
+public:
+    CBinLogReader();
+    ~CBinLogReader();
+
+    /***
+      * 打开二进制日志文件，也可以是滚动后被压缩的文件（如x.log.20240101.gz），
+      * 压缩的文件按魔数识别，整个解压到内存中再读取
+      * @exception: 如果出错，抛出CSyscallException异常，解压出错抛出utils::CException异常
+      */
+    void open(const char* filepath);
+    void close();
+
+    /***
+      * 读取下一条日志记录，格式定义记录在内部处理，不返回给调用者
+      * 遇到损坏的数据时，向后查找下一个魔数，跳过的字节数可由get_skipped_bytes得到
+      * @header: 用来存储记录头
+      * @return: 到文件尾时返回false，结尾不完整的记录被忽略
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    bool next(bin_log_header_t* header);
+
+    /***
+      * 将当前记录格式化成文本，不包含头部
+      * 包括“[文件名:行号]”和日志内容，结尾没有换行符的不会添加换行符
+      */
+    std::string get_message() const;
+
+    /***
+      * 将当前记录格式化成和CLogger文本日志相同格式的一行
+      * 日志头形如“[2012-12-12 12:12:12/123456][0x12345678][DEBUG]”，结尾总是有换行符
+      */
+    std::string get_line() const;
+
+    /** 得到因为数据损坏而跳过的字节数 */
+    uint64_t get_skipped_bytes() const { return _skipped_bytes; }
+
+private:
+    bool read_record();
+    void add_format(const bin_log_header_t& header, const std::string& content);
+
+private:
+    FILE* _fp;
+    std::string _data;      // 压缩的文件解压后的数据，_fp以fmemopen读取它
+    uint64_t _skipped_bytes;
+    bin_log_header_t _header;
+    std::string _content;   // 当前记录头部之后的内容
+    std::map<uint32_t, bin_log_format_t> _formats;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 结构化日志宏，每个调用点的格式串只在第一次调用时注册一次
+// “if (false) printf”用于在编译时检查格式和参数是否匹配，不会被执行
+#define __MYLOG_STRUCT(logger, log_level, enabled_method, format, ...) \
+do { \
+    if (__MYLOG_COMPILED(log_level) && (logger != NULL) && __MYLOG_LOGGER_ON(logger, log_level, enabled_method)) { \
+        static const uint32_t bin_log_format_id = ::mooon::sys::register_bin_log_format(log_level, __FILE__, __LINE__, format); \
+        if (false) printf(format, ##__VA_ARGS__); \
+        logger->log_struct(bin_log_format_id, ##__VA_ARGS__); \
+    } \
+} while(false)
+
+#define MYLOG_STRUCT_TRACE(format, ...)  __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_TRACE, enabled_trace, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_STATE(format, ...)  __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_STATE, enabled_state, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_FATAL(format, ...)  __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_FATAL, enabled_fatal, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_ERROR(format, ...)  __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_ERROR, enabled_error, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_WARN(format, ...)   __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_WARN, enabled_warn, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_INFO(format, ...)   __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_INFO, enabled_info, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_DEBUG(format, ...)  __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_DEBUG, enabled_debug, format, ##__VA_ARGS__)
+#define MYLOG_STRUCT_DETAIL(format, ...) __MYLOG_STRUCT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_DETAIL, enabled_detail, format, ##__VA_ARGS__)
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_BIN_LOG_H
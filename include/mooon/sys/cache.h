@@ -0,0 +1,745 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_CACHE_H
+#define MOOON_SYS_CACHE_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/snapshot.h"
+#include "mooon/utils/flat_hash_map.h"
+#include "mooon/utils/timing_wheel.h"
+#include <exception>
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/** 缓存满时的淘汰算法 */
+typedef enum
+{
+    eviction_lru   = 0, /** 淘汰最久未访问的，命中时移到链表头 */
+    eviction_clock = 1  /** CLOCK近似LRU，命中时只置访问位，读多时锁内的写更少 */
+}cache_eviction_t;
+
+/** CConcurrentCache的参数 */
+struct cache_policy_t
+{
+    uint32_t capacity;           /** 总条目数上限，平均分到各分片 */
+    uint32_t shard_number;       /** 分片数，取整为2的幂 */
+    cache_eviction_t eviction;
+    bool tinylfu;                /** 满时以TinyLFU决定是否接纳新条目：新条目的访问频率不高于被淘汰者时不接纳，防止扫描冲掉热点 */
+    uint32_t ttl_milliseconds;   /** 默认的存活毫秒数，为0表示不过期 */
+    uint32_t tick_milliseconds;  /** 过期时间轮的刻度，过期的条目最迟在这之后被清除，但过期后不会再被读到 */
+
+    cache_policy_t()
+        : capacity(10000), shard_number(16), eviction(eviction_lru), tinylfu(false),
+          ttl_milliseconds(0), tick_milliseconds(100)
+    {
+    }
+};
+
+/** 缓存的统计 */
+struct cache_stats_t
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;     /** 因满被淘汰的 */
+    uint64_t expirations;   /** 因过期被删除的 */
+    uint64_t rejections;    /** 未被TinyLFU接纳的 */
+    uint64_t loads;         /** get_or_load中调用加载函数的次数 */
+    uint64_t shared_loads;  /** get_or_load中等待其它线程加载结果的次数 */
+
+    cache_stats_t()
+        : hits(0), misses(0), evictions(0), expirations(0), rejections(0), loads(0), shared_loads(0)
+    {
+    }
+};
+
+/***
+  * 访问频率的估计（count-min sketch），4行4位计数器，
+  * 计数总数达到宽度的10倍时全部减半，使得频率反映最近一段时间的访问
+  */
+class CFrequencySketch
+{
+public:
+    CFrequencySketch(uint32_t capacity)
+        : _additions(0)
+    {
+        uint32_t width = 64;
+        while (width < capacity)
+            width <<= 1;
+        _mask = width - 1;
+        _sample_size = width * 10;
+        _table.assign(width * SKETCH_DEPTH / 2, 0); // 一个字节两个计数器
+    }
+
+    void increment(size_t hash)
+    {
+        bool added = false;
+        for (uint32_t i=0; i<SKETCH_DEPTH; ++i)
+        {
+            const uint32_t index = get_index(hash, i);
+            uint8_t& byte = _table[index / 2];
+            const int shift = (index & 1) * 4;
+            if (((byte >> shift) & 0x0F) < 0x0F)
+            {
+                byte = static_cast<uint8_t>(byte + (1 << shift));
+                added = true;
+            }
+        }
+        if (added && (++_additions >= _sample_size))
+            reset();
+    }
+
+    uint32_t estimate(size_t hash) const
+    {
+        uint32_t frequency = 0x0F;
+        for (uint32_t i=0; i<SKETCH_DEPTH; ++i)
+        {
+            const uint32_t index = get_index(hash, i);
+            const uint32_t count = (_table[index / 2] >> ((index & 1) * 4)) & 0x0F;
+            if (count < frequency)
+                frequency = count;
+        }
+        return frequency;
+    }
+
+private:
+    enum { SKETCH_DEPTH = 4 };
+
+    // 双重哈希，每行一个位置，位置的序号是计数器的序号
+    uint32_t get_index(size_t hash, uint32_t row) const
+    {
+        const uint64_t h = static_cast<uint64_t>(hash) * UINT64_C(0x9E3779B97F4A7C15);
+        const uint64_t step = (h >> 32) | 1;
+        const uint32_t width = _mask + 1;
+        return row * width + static_cast<uint32_t>((h + row * step) & _mask);
+    }
+
+    void reset()
+    {
+        // 每个字节的两个计数器各自减半
+        for (std::vector<uint8_t>::size_type i=0; i<_table.size(); ++i)
+            _table[i] = static_cast<uint8_t>((_table[i] >> 1) & 0x77);
+        _additions /= 2;
+    }
+
+private:
+    uint32_t _mask;
+    uint32_t _sample_size;
+    uint32_t _additions;
+    std::vector<uint8_t> _table;
+};
+
+/***
+  * 分片的线程安全缓存，用于DB、ZooKeeper和DNS等查询结果的缓存：
+  * 1) 键按哈希分到各分片，每个分片一把锁，不同分片互不竞争
+  * 2) 满时按LRU或CLOCK淘汰，可选TinyLFU接纳
+  * 3) 每个条目可有自己的TTL，过期的由各分片的时间轮（utils::CTimingWheel）在访问该分片时清除
+  * 4) get_or_load合并同一个键的并发缺失（single-flight）：只有第一个缺失者调用加载函数，
+  *    其它的等待它的结果，避免发布或缓存失效后的击穿
+  * 5) 指定metrics_name时，命中、缺失、淘汰等计入CMetricsRegistry的计数器cache.<名字>.hits等
+  *
+  * Value以值的方式存放和返回，大的值（如查询结果表）应使用std::shared_ptr<const T>。
+  *
+  * 使用示例：
+  * CConcurrentCache<std::string, std::string> cache(policy, "dns");
+  * std::string ip;
+  * cache.get_or_load(host, resolve, &ip); // bool resolve(const std::string& host, std::string* ip)
+  */
+template <typename Key, typename Value, typename Hash=std::hash<Key> >
+class CConcurrentCache
+{
+public:
+    CConcurrentCache(const cache_policy_t& policy=cache_policy_t(), const std::string& metrics_name=std::string())
+        : _policy(policy)
+    {
+        uint32_t number = 1;
+        while (number < policy.shard_number)
+            number <<= 1;
+        _shard_capacity = (policy.capacity + number - 1) / number;
+        if (0 == _shard_capacity)
+            _shard_capacity = 1;
+
+        _shards.resize(number);
+        for (uint32_t i=0; i<number; ++i)
+            _shards[i] = new Shard(this);
+
+        _counters.resize(counter_number, NULL);
+        if (!metrics_name.empty())
+        {
+            static const char* const suffixes[counter_number] = { ".hits", ".misses", ".evictions", ".expirations", ".rejections", ".loads", ".shared_loads" };
+            for (int i=0; i<counter_number; ++i)
+                _counters[i] = CMetricsRegistry::get_singleton()->get_counter("cache." + metrics_name + suffixes[i]);
+        }
+    }
+
+    ~CConcurrentCache()
+    {
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+            delete _shards[i];
+    }
+
+    /***
+      * 取得键的值
+      * @return: 不存在或已过期返回false
+      */
+    bool get(const Key& key, Value* value)
+    {
+        const size_t hash = Hash()(key);
+        Shard* shard = get_shard(hash);
+        LockHelper<CLock> lock_helper(shard->lock);
+        return shard->lookup(key, hash, value);
+    }
+
+    /***
+      * 放入或更新键的值
+      * @ttl_milliseconds: 存活毫秒数，为0时使用cache_policy_t::ttl_milliseconds
+      * @return: 未被TinyLFU接纳时返回false
+      */
+    bool put(const Key& key, const Value& value, uint32_t ttl_milliseconds=0)
+    {
+        const size_t hash = Hash()(key);
+        Shard* shard = get_shard(hash);
+        LockHelper<CLock> lock_helper(shard->lock);
+        return shard->insert(key, hash, value, ttl_milliseconds);
+    }
+
+    /***
+      * 取得键的值，不存在时以loader加载并放入缓存，同一个键的并发加载只调用一次loader
+      * @loader: bool loader(const Key& key, Value* value)，返回false表示不存在或加载失败，不放入缓存
+      * @return: 取得值时返回true，
+      *  等待其它线程加载而它失败（返回false或抛出异常）时返回false，
+      *  自己调用loader抛出的异常会传给调用者
+      */
+    template <class Loader>
+    bool get_or_load(const Key& key, Loader loader, Value* value, uint32_t ttl_milliseconds=0)
+    {
+        const size_t hash = Hash()(key);
+        Shard* shard = get_shard(hash);
+        Flight* flight;
+
+        {
+            LockHelper<CLock> lock_helper(shard->lock);
+            if (shard->lookup(key, hash, value))
+                return true;
+
+            typename flight_table_t::iterator iter = shard->flights.find(key);
+            if (iter != shard->flights.end())
+            {
+                // 已有线程在加载，等它的结果
+                flight = iter->second;
+                ++flight->refcount;
+                shard->add(counter_shared_loads);
+                while (!flight->done)
+                    flight->event.wait(shard->lock);
+
+                const bool success = flight->success;
+                if (success)
+                    *value = flight->value;
+                if (0 == --flight->refcount)
+                    delete flight;
+                return success;
+            }
+
+            flight = new Flight;
+            shard->flights.insert(key, flight);
+            shard->add(counter_loads);
+        }
+
+        // 在锁外加载
+        std::exception_ptr error;
+        bool success = false;
+        try
+        {
+            success = loader(key, &flight->value);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            LockHelper<CLock> lock_helper(shard->lock);
+            flight->done = true;
+            flight->success = success;
+            shard->flights.erase(key);
+            if (success)
+            {
+                (void)shard->insert(key, hash, flight->value, ttl_milliseconds);
+                *value = flight->value;
+            }
+            flight->event.broadcast();
+            if (0 == --flight->refcount)
+                delete flight;
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+        return success;
+    }
+
+    /** 删除键，返回键是否存在 */
+    bool remove(const Key& key)
+    {
+        const size_t hash = Hash()(key);
+        Shard* shard = get_shard(hash);
+        LockHelper<CLock> lock_helper(shard->lock);
+
+        typename entry_table_t::iterator iter = shard->entries.find(key);
+        if (iter == shard->entries.end())
+            return false;
+        shard->erase(iter->second);
+        return true;
+    }
+
+    /** 删除所有键 */
+    void clear()
+    {
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            LockHelper<CLock> lock_helper(_shards[i]->lock);
+            _shards[i]->clear();
+        }
+    }
+
+    /***
+      * 清除所有分片中已过期的条目，访问较少的缓存可定时调用，以及时释放内存
+      * @return: 清除的条目数
+      */
+    uint64_t expire()
+    {
+        uint64_t number = 0;
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            LockHelper<CLock> lock_helper(_shards[i]->lock);
+            const uint64_t expirations = _shards[i]->stats[counter_expirations];
+            _shards[i]->check_timeout(get_now());
+            number += _shards[i]->stats[counter_expirations] - expirations;
+        }
+        return number;
+    }
+
+    /** 得到条目数，包括已过期但还未被清除的 */
+    size_t size() const
+    {
+        size_t number = 0;
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            LockHelper<CLock> lock_helper(_shards[i]->lock);
+            number += _shards[i]->entries.size();
+        }
+        return number;
+    }
+
+    void get_stats(cache_stats_t* stats) const
+    {
+        uint64_t* values[counter_number] = { &stats->hits, &stats->misses, &stats->evictions, &stats->expirations, &stats->rejections, &stats->loads, &stats->shared_loads };
+        *stats = cache_stats_t();
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            LockHelper<CLock> lock_helper(_shards[i]->lock);
+            for (int j=0; j<counter_number; ++j)
+                *values[j] += _shards[i]->stats[j];
+        }
+    }
+
+    const cache_policy_t& get_policy() const { return _policy; }
+
+    /***
+      * 遍历所有未过期的条目，逐个分片加锁，每个分片内从最久未访问的到最近访问的（CLOCK时按环的顺序），
+      * 按遍历的顺序put即可重建出相同的LRU顺序，用于保存快照（见CCacheSnapshot）
+      * @visitor: void visitor(const Key& key, const Value& value, uint32_t ttl_milliseconds)，
+      *           ttl_milliseconds为剩余的存活毫秒数，0表示不过期
+      */
+    template <class Visitor>
+    void visit(Visitor visitor) const
+    {
+        const uint64_t now = get_now();
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            Shard* shard = _shards[i];
+            LockHelper<CLock> lock_helper(shard->lock);
+
+            if (eviction_clock == _policy.eviction)
+            {
+                for (typename std::vector<Entry*>::size_type j=0; j<shard->clock_ring.size(); ++j)
+                    visit_entry(shard->clock_ring[j], now, visitor);
+            }
+            else
+            {
+                for (const Entry* entry=shard->lru_head.prev; entry!=&shard->lru_head; entry=entry->prev)
+                    visit_entry(entry, now, visitor);
+            }
+        }
+    }
+
+private:
+    enum
+    {
+        counter_hits = 0,
+        counter_misses,
+        counter_evictions,
+        counter_expirations,
+        counter_rejections,
+        counter_loads,
+        counter_shared_loads,
+        counter_number
+    };
+
+    struct Entry: public utils::CWheelTimeoutable
+    {
+        Key key;
+        Value value;
+        size_t hash;
+        uint64_t expire_time;   // 过期的毫秒时间，为0表示不过期
+        Entry* prev;            // LRU链表
+        Entry* next;
+        uint32_t clock_index;   // 在CLOCK环中的位置
+        bool referenced;        // CLOCK的访问位
+
+        Entry(const Key& key_, const Value& value_, size_t hash_)
+            : key(key_), value(value_), hash(hash_), expire_time(0),
+              prev(NULL), next(NULL), clock_index(0), referenced(false)
+        {
+        }
+    };
+
+    struct Flight
+    {
+        CEvent event;
+        Value value;
+        uint32_t refcount;      // 加载者和等待者的个数
+        bool done;
+        bool success;
+
+        Flight(): value(), refcount(1), done(false), success(false) {}
+    };
+
+    typedef utils::CFlatHashMap<Key, Entry*, Hash> entry_table_t;
+    typedef utils::CFlatHashMap<Key, Flight*, Hash> flight_table_t;
+
+    struct Shard: public utils::ITimeoutHandler<Entry>
+    {
+        CConcurrentCache* cache;
+        mutable CLock lock;
+        entry_table_t entries;
+        flight_table_t flights;
+        Entry lru_head;                 // LRU链表的哨兵，next为最近访问的
+        std::vector<Entry*> clock_ring;
+        uint32_t clock_hand;
+        utils::CTimingWheel<Entry> wheel;
+        CFrequencySketch sketch;
+        uint64_t stats[counter_number];
+
+        Shard(CConcurrentCache* cache_)
+            : cache(cache_), lru_head(Key(), Value(), 0), clock_hand(0),
+              wheel(cache_->_policy.tick_milliseconds), sketch(cache_->_shard_capacity)
+        {
+            lru_head.prev = &lru_head;
+            lru_head.next = &lru_head;
+            for (int i=0; i<counter_number; ++i)
+                stats[i] = 0;
+            wheel.set_timeout_handler(this);
+        }
+
+        ~Shard()
+        {
+            clear();
+        }
+
+        void add(int counter)
+        {
+            ++stats[counter];
+            if (cache->_counters[counter] != NULL)
+                cache->_counters[counter]->inc();
+        }
+
+        void check_timeout(uint64_t now)
+        {
+            wheel.check_timeout(now);
+        }
+
+        // 时间轮回调，条目已被移出时间轮
+        virtual void on_timeout_event(Entry* entry)
+        {
+            add(counter_expirations);
+            erase(entry);
+        }
+
+        bool lookup(const Key& key, size_t hash, Value* value)
+        {
+            const uint64_t now = get_now();
+            check_timeout(now);
+            if (cache->_policy.tinylfu)
+                sketch.increment(hash);
+
+            typename entry_table_t::iterator iter = entries.find(key);
+            if (iter == entries.end())
+            {
+                add(counter_misses);
+                return false;
+            }
+
+            Entry* entry = iter->second;
+            if ((entry->expire_time != 0) && (entry->expire_time <= now))
+            {
+                // 时间轮按刻度清除，刻度内已过期的在这里删除
+                add(counter_expirations);
+                add(counter_misses);
+                erase(entry);
+                return false;
+            }
+
+            touch(entry);
+            *value = entry->value;
+            add(counter_hits);
+            return true;
+        }
+
+        bool insert(const Key& key, size_t hash, const Value& value, uint32_t ttl_milliseconds)
+        {
+            const uint64_t now = get_now();
+            const uint32_t ttl = (ttl_milliseconds > 0)? ttl_milliseconds: cache->_policy.ttl_milliseconds;
+            Entry* entry;
+
+            check_timeout(now);
+            if (cache->_policy.tinylfu)
+                sketch.increment(hash);
+
+            typename entry_table_t::iterator iter = entries.find(key);
+            if (iter != entries.end())
+            {
+                entry = iter->second;
+                entry->value = value;
+                touch(entry);
+            }
+            else
+            {
+                if (entries.size() >= cache->_shard_capacity)
+                {
+                    Entry* victim = select_victim();
+                    if (cache->_policy.tinylfu && (sketch.estimate(hash) <= sketch.estimate(victim->hash)))
+                    {
+                        add(counter_rejections);
+                        return false;
+                    }
+
+                    add(counter_evictions);
+                    erase(victim);
+                }
+
+                entry = new Entry(key, value, hash);
+                entries.insert(key, entry);
+                if (eviction_clock == cache->_policy.eviction)
+                {
+                    entry->clock_index = static_cast<uint32_t>(clock_ring.size());
+                    clock_ring.push_back(entry);
+                }
+                else
+                {
+                    link_front(entry);
+                }
+            }
+
+            if (ttl > 0)
+            {
+                entry->expire_time = now + ttl;
+                wheel.push(entry, now, ttl);
+            }
+            else
+            {
+                entry->expire_time = 0;
+                wheel.remove(entry);
+            }
+            return true;
+        }
+
+        void touch(Entry* entry)
+        {
+            if (eviction_clock == cache->_policy.eviction)
+            {
+                entry->referenced = true;
+            }
+            else
+            {
+                unlink(entry);
+                link_front(entry);
+            }
+        }
+
+        Entry* select_victim()
+        {
+            if (eviction_lru == cache->_policy.eviction)
+                return lru_head.prev;
+
+            // 跳过并清除访问位，第一个没有访问位的被淘汰，最多转两圈
+            while (true)
+            {
+                if (clock_hand >= clock_ring.size())
+                    clock_hand = 0;
+                Entry* entry = clock_ring[clock_hand++];
+                if (!entry->referenced)
+                    return entry;
+                entry->referenced = false;
+            }
+        }
+
+        void erase(Entry* entry)
+        {
+            entries.erase(entry->key);
+            wheel.remove(entry);
+            if (eviction_clock == cache->_policy.eviction)
+            {
+                // 以环尾的条目填补
+                Entry* last = clock_ring.back();
+                clock_ring[entry->clock_index] = last;
+                last->clock_index = entry->clock_index;
+                clock_ring.pop_back();
+            }
+            else
+            {
+                unlink(entry);
+            }
+            delete entry;
+        }
+
+        void clear()
+        {
+            for (typename entry_table_t::iterator iter=entries.begin(); iter!=entries.end(); ++iter)
+            {
+                wheel.remove(iter->second);
+                delete iter->second;
+            }
+            entries.clear();
+            clock_ring.clear();
+            clock_hand = 0;
+            lru_head.prev = &lru_head;
+            lru_head.next = &lru_head;
+        }
+
+        void link_front(Entry* entry)
+        {
+            entry->prev = &lru_head;
+            entry->next = lru_head.next;
+            lru_head.next->prev = entry;
+            lru_head.next = entry;
+        }
+
+        static void unlink(Entry* entry)
+        {
+            entry->prev->next = entry->next;
+            entry->next->prev = entry->prev;
+        }
+    };
+
+private:
+    template <class Visitor>
+    static void visit_entry(const Entry* entry, uint64_t now, Visitor& visitor)
+    {
+        if (0 == entry->expire_time)
+            visitor(entry->key, entry->value, 0);
+        else if (entry->expire_time > now)
+            visitor(entry->key, entry->value, static_cast<uint32_t>(entry->expire_time - now));
+    }
+
+    Shard* get_shard(size_t hash) const
+    {
+        // 用哈希的高位选分片，CFlatHashMap用低位，避免同一分片中的键低位相同
+        const uint64_t h = static_cast<uint64_t>(hash) * UINT64_C(0x9E3779B97F4A7C15);
+        return _shards[(h >> 40) & (_shards.size() - 1)];
+    }
+
+    static uint64_t get_now()
+    {
+        return CClock::get_coarse_nanoseconds() / 1000000;
+    }
+
+private:
+    const cache_policy_t _policy;
+    uint32_t _shard_capacity;
+    std::vector<Shard*> _shards;
+    std::vector<CCounter*> _counters;
+};
+
+/***
+  * CConcurrentCache的快照适配，使缓存可登记到CSnapshotManager（或CMainHelper::register_snapshot），
+  * 重启后新进程带着旧进程的缓存启动，剩余的TTL扣除快照保存后经过的时间，已过期的不恢复。
+  * 键和值以snapshot_write和snapshot_read读写（见sys/snapshot.h），已支持整数和std::string，
+  * 其它类型在其名字空间中重载这两个函数即可。
+  *
+  * 使用示例：
+  * CConcurrentCache<std::string, std::string> cache(policy, "user");
+  * CCacheSnapshot<std::string, std::string> cache_snapshot(&cache);
+  * register_snapshot("user_cache", &cache_snapshot); // 在CMainHelper::on_init中
+  */
+template <typename Key, typename Value, typename Hash=std::hash<Key> >
+class CCacheSnapshot: public ISnapshotable
+{
+public:
+    CCacheSnapshot(CConcurrentCache<Key, Value, Hash>* cache)
+        : _cache(cache)
+    {
+    }
+
+    virtual void save_snapshot(CSnapshotWriter* writer)
+    {
+        _cache->visit(EntryWriter(writer));
+    }
+
+    virtual bool load_snapshot(CSnapshotReader* reader)
+    {
+        const uint64_t elapsed_milliseconds = reader->get_elapsed_milliseconds();
+        while (!reader->eof())
+        {
+            Key key;
+            Value value;
+            uint32_t ttl_milliseconds;
+            if (!snapshot_read(reader, &ttl_milliseconds) || !snapshot_read(reader, &key) || !snapshot_read(reader, &value))
+                return false;
+
+            if (0 == ttl_milliseconds)
+                (void)_cache->put(key, value, 0);
+            else if (ttl_milliseconds > elapsed_milliseconds)
+                (void)_cache->put(key, value, static_cast<uint32_t>(ttl_milliseconds - elapsed_milliseconds));
+        }
+        return true;
+    }
+
+private:
+    struct EntryWriter
+    {
+        CSnapshotWriter* writer;
+
+        EntryWriter(CSnapshotWriter* writer_): writer(writer_) {}
+
+        void operator ()(const Key& key, const Value& value, uint32_t ttl_milliseconds)
+        {
+            snapshot_write(writer, ttl_milliseconds);
+            snapshot_write(writer, key);
+            snapshot_write(writer, value);
+        }
+    };
+
+private:
+    CConcurrentCache<Key, Value, Hash>* _cache;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CACHE_H
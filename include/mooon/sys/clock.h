@@ -0,0 +1,68 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_CLOCK_H
+#define MOOON_SYS_CLOCK_H
+#include "mooon/sys/config.h"
+#include <stdint.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 单调时钟，不受NTP和修改系统时间的影响，只适用于计算时间间隔。
+  * CPU支持不变TSC（invariant TSC）且内核也使用TSC作为时钟源时，直接读TSC，
+  * 不经过系统调用和vDSO中的seqlock，第一次使用时以CLOCK_MONOTONIC_RAW为基准校准TSC频率（约5毫秒）；
+  * 否则使用clock_gettime(CLOCK_MONOTONIC)。
+  *
+  * 粗粒度的get_coarse_nanoseconds使用CLOCK_MONOTONIC_COARSE，精度为一个时钟中断（通常1~4毫秒），
+  * 但比get_nanoseconds更快，适用于超时判断等不需要高精度的场景。
+  */
+class CClock
+{
+public:
+    typedef enum
+    {
+        source_tsc = 0,      // 校准后的TSC
+        source_monotonic = 1 // clock_gettime(CLOCK_MONOTONIC)
+    }source_t;
+
+    /** 得到当前使用的时钟源 */
+    static source_t get_source();
+
+    /***
+      * 强制使用CLOCK_MONOTONIC，不再使用TSC，
+      * 非线程安全，应在使用前调用，仅用于测试和对比
+      */
+    static void disable_tsc();
+
+    /** 得到单调时钟的纳秒值，起点不确定，只能用于计算时间间隔 */
+    static uint64_t get_nanoseconds();
+    static uint64_t get_microseconds() { return get_nanoseconds() / 1000; }
+    static uint64_t get_milliseconds() { return get_nanoseconds() / 1000000; }
+
+    /** 得到CLOCK_MONOTONIC_COARSE的纳秒值，与get_nanoseconds的起点不同，不能混用 */
+    static uint64_t get_coarse_nanoseconds();
+
+    /** 得到校准后的TSC频率（每秒的周期数），不使用TSC时返回0 */
+    static uint64_t get_tsc_frequency();
+
+    /** 将TSC周期数（CUtils::rdtsc的差值）转换成纳秒数，不使用TSC时返回0 */
+    static uint64_t cycles_to_nanoseconds(uint64_t cycles);
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CLOCK_H
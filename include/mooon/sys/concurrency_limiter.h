@@ -0,0 +1,254 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_CONCURRENCY_LIMITER_H
+#define MOOON_SYS_CONCURRENCY_LIMITER_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/spin_lock.h"
+#include <string>
+SYS_NAMESPACE_BEGIN
+
+/** 一次调用的结果，决定如何调整并发限制 */
+enum limit_outcome_t
+{
+    limit_success, /** 正常完成（包括业务错误，如SQL语法错误），耗时有效 */
+    limit_dropped, /** 超时或被下游以过载拒绝，是过载的信号 */
+    limit_ignored  /** 与下游负载无关的失败（如参数错误），不调整 */
+};
+
+/***
+  * 并发限制算法，调用完成时由CConcurrencyLimiter在锁内调用，不需要线程安全
+  */
+class ILimitAlgorithm
+{
+public:
+    virtual ~ILimitAlgorithm() {}
+
+    /** 初始的并发限制 */
+    virtual uint32_t get_initial_limit() const = 0;
+
+    /***
+      * 一次调用完成，返回新的并发限制
+      * @limit: 当前的并发限制
+      * @in_flight: 该调用开始时的在途数，包括它自己
+      * @rtt_nanoseconds: 该调用的耗时
+      * @dropped: 是否为limit_dropped
+      */
+    virtual uint32_t update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped) = 0;
+};
+
+/***
+  * AIMD（加性增、乘性减），同TCP的拥塞控制：
+  * 调用被丢弃或耗时超过timeout_milliseconds时限制乘以backoff_ratio，
+  * 否则在途数达到限制的一半以上（限制确实被用到了）时加一。
+  * 不需要估计无负载的耗时，适合耗时波动大、只以超时为过载信号的下游。
+  */
+class CAimdLimit: public ILimitAlgorithm
+{
+public:
+    /***
+      * @timeout_milliseconds: 为0表示只以limit_dropped为过载信号
+      * @backoff_ratio: 乘性减的比例，取(0.5, 1)
+      */
+    CAimdLimit(uint32_t initial_limit=20, uint32_t min_limit=1, uint32_t max_limit=1000,
+               uint32_t timeout_milliseconds=0, double backoff_ratio=0.9);
+
+    virtual uint32_t get_initial_limit() const { return _initial_limit; }
+    virtual uint32_t update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped);
+
+private:
+    uint32_t _initial_limit;
+    uint32_t _min_limit;
+    uint32_t _max_limit;
+    uint64_t _timeout_nanoseconds;
+    double _backoff_ratio;
+};
+
+/***
+  * Vegas，同TCP Vegas：以最小耗时作为无负载的耗时rtt_noload，
+  * 估计下游排队的请求数queue=limit*(1-rtt_noload/rtt)，
+  * queue小于alpha时限制增加，大于beta时减少，alpha和beta随限制按log10增长，
+  * 丢弃时同样减少。每probe_interval次调用重新测量一次rtt_noload，
+  * 以免下游变慢后一直拿旧的最小值比较而不断收缩。
+  * 适合耗时稳定、排队会直接体现在耗时上的下游，如Redis和简单的DB查询。
+  */
+class CVegasLimit: public ILimitAlgorithm
+{
+public:
+    CVegasLimit(uint32_t initial_limit=20, uint32_t min_limit=1, uint32_t max_limit=1000, uint32_t probe_interval=1000);
+
+    virtual uint32_t get_initial_limit() const { return _initial_limit; }
+    virtual uint32_t update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped);
+
+private:
+    uint32_t _initial_limit;
+    uint32_t _min_limit;
+    uint32_t _max_limit;
+    uint32_t _probe_interval;
+    uint32_t _sample_number;  /** 距上次重新测量rtt_noload的调用数 */
+    uint64_t _rtt_noload;     /** 0表示还未测量 */
+};
+
+/***
+  * 梯度算法（Gradient2）：以耗时的长期指数移动平均为基准，
+  * 梯度gradient=长期平均/本次耗时，取[0.5, 1]，新限制为limit*gradient+sqrt(limit)，
+  * 再和当前限制平滑，耗时升高时按比例收缩，耗时正常时逐步增长（sqrt(limit)为允许的排队量）。
+  * 耗时超过长期平均的1.5倍（在排队）时不计入长期平均，否则它会跟着排队一起升高而失去基准作用，
+  * 连续long_window次都如此、且期间限制已减半时才以当前耗时为新的基准（下游本身变慢了）；
+  * 长期平均比本次耗时大一倍以上时（下游已恢复）让它快速衰减，以免恢复后仍长时间偏保守。
+  * 不依赖最小耗时，对耗时的缓慢漂移不敏感，适合多数场景，是默认推荐的算法。
+  */
+class CGradientLimit: public ILimitAlgorithm
+{
+public:
+    /***
+      * @smoothing: 新限制的权重，取(0, 1]
+      * @long_window: 长期平均的窗口（调用数）
+      */
+    CGradientLimit(uint32_t initial_limit=20, uint32_t min_limit=1, uint32_t max_limit=1000,
+                   double smoothing=0.2, uint32_t long_window=600);
+
+    virtual uint32_t get_initial_limit() const { return _initial_limit; }
+    virtual uint32_t update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped);
+
+private:
+    uint32_t _initial_limit;
+    uint32_t _min_limit;
+    uint32_t _max_limit;
+    double _smoothing;
+    uint32_t _long_window;
+    double _long_factor;       /** 长期平均新值的权重，即2/(long_window+1) */
+    double _long_rtt;          /** 0表示还没有样本 */
+    uint32_t _queueing_number; /** 连续超过长期平均1.5倍的次数 */
+    double _queueing_limit;    /** 开始连续超过时的限制 */
+    double _estimated_limit;
+};
+
+/** 一次被允许的调用，由try_acquire填写，结束时交给release */
+struct CLimitTicket
+{
+    uint64_t start_nanoseconds; /** 开始的CClock纳秒数 */
+    uint32_t in_flight;         /** 开始时的在途数，包括自己 */
+
+    CLimitTicket(): start_nanoseconds(0), in_flight(0) {}
+};
+
+/***
+  * 自适应并发限制，放在DB、Redis、Thrift和HBase等客户端的调用外面：
+  * 在途的调用数达到限制时新调用立即被拒绝（不排队、不加锁，只有一次原子操作），
+  * 调用完成时按耗时和结果由算法（AIMD、Vegas或梯度）调整限制，
+  * 下游变慢时收缩，健康时增长，使下游保持在吞吐的峰值附近，
+  * 而不是在过载时因为越来越多的排队和重试而崩溃（Little定律：并发=吞吐*耗时）。
+  * 线程安全，只有调整限制时持有一把自适应锁。
+  *
+  * 度量（metrics_name不为空时）：
+  * concurrency_limiter.<name>.limit（gauge）、in_flight（gauge）、rejected（counter）和dropped（counter）
+  *
+  * 使用示例：
+  * static CConcurrencyLimiter limiter(new CGradientLimit, "hbase");
+  * CLimitGuard guard(&limiter);
+  * if (!guard.is_acquired())
+  *     return SERVER_BUSY; // 快速失败，不要重试
+  * try
+  * {
+  *     hbase_client->get(...);
+  *     guard.set_outcome(limit_success);
+  * }
+  * catch (CTimeoutException&)
+  * {
+  *     guard.set_outcome(limit_dropped);
+  *     throw;
+  * }
+  */
+class CConcurrencyLimiter
+{
+public:
+    /***
+      * @algorithm: 调整的算法，所有权转移给CConcurrencyLimiter
+      * @metrics_name: 不为空时记录度量
+      */
+    explicit CConcurrencyLimiter(ILimitAlgorithm* algorithm, const std::string& metrics_name=std::string());
+    ~CConcurrencyLimiter();
+
+    /***
+      * 尝试开始一次调用
+      * @ticket: 成功时填写，须在调用结束时交给release
+      * @return: 在途数未达限制时返回true，否则立即返回false
+      */
+    bool try_acquire(CLimitTicket* ticket);
+
+    /** 一次调用结束，每次成功的try_acquire必须对应一次release */
+    void release(const CLimitTicket& ticket, limit_outcome_t outcome);
+
+    uint32_t get_limit() const { return __atomic_load_n(&_limit, __ATOMIC_RELAXED); }
+    uint32_t get_in_flight() const { return __atomic_load_n(&_in_flight, __ATOMIC_RELAXED); }
+    uint64_t get_rejected_number() const { return __atomic_load_n(&_rejected_number, __ATOMIC_RELAXED); }
+
+private:
+    CConcurrencyLimiter(const CConcurrencyLimiter&);
+    CConcurrencyLimiter& operator =(const CConcurrencyLimiter&);
+
+private:
+    ILimitAlgorithm* _algorithm;
+    CAdaptiveLock _lock; /** 保护_algorithm */
+    uint32_t _limit;
+    uint32_t _in_flight;
+    uint64_t _rejected_number;
+    CGauge* _limit_gauge;
+    CGauge* _in_flight_gauge;
+    CCounter* _rejected_counter;
+    CCounter* _dropped_counter;
+};
+
+/***
+  * 同步调用的帮助类，构造时try_acquire，析构时release，
+  * 未调用set_outcome时（如抛出了异常）按limit_ignored释放，
+  * limiter为NULL时总是允许，以便限制可选
+  */
+class CLimitGuard
+{
+public:
+    explicit CLimitGuard(CConcurrencyLimiter* limiter)
+        : _limiter(limiter), _outcome(limit_ignored)
+    {
+        _acquired = (NULL == _limiter) || _limiter->try_acquire(&_ticket);
+    }
+
+    ~CLimitGuard()
+    {
+        if (_acquired && (_limiter != NULL))
+            _limiter->release(_ticket, _outcome);
+    }
+
+    bool is_acquired() const { return _acquired; }
+    void set_outcome(limit_outcome_t outcome) { _outcome = outcome; }
+
+private:
+    CLimitGuard(const CLimitGuard&);
+    CLimitGuard& operator =(const CLimitGuard&);
+
+private:
+    CConcurrencyLimiter* _limiter;
+    CLimitTicket _ticket;
+    limit_outcome_t _outcome;
+    bool _acquired;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CONCURRENCY_LIMITER_H
@@ -0,0 +1,245 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_CONFIG_SNAPSHOT_H
+#define MOOON_SYS_CONFIG_SNAPSHOT_H
+#include "mooon/sys/config_file.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/syscall_exception.h"
+#include <memory>
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+class CThreadEngine;
+
+/***
+  * 配置项的句柄，由CConfigCache的add_*得到，
+  * 之后以句柄从快照读取，不再按路径和名字查找
+  */
+template <typename ValueType>
+struct config_handle_t
+{
+    uint32_t index; // 配置项的下标，也是IConfigObserver中changed_indexes的值
+};
+
+/***
+  * 配置快照，只读，一经发布不再修改，
+  * 各get只是按下标取值，不加锁也不查找
+  */
+class CConfigSnapshot
+{
+    friend class CConfigCache;
+
+public:
+    /** 版本号，每次发布新快照加1 */
+    uint64_t get_version() const { return _version; }
+
+    /** 配置项的个数 */
+    uint32_t get_item_number() const { return static_cast<uint32_t>(_values.size()); }
+
+    bool get(config_handle_t<bool> handle) const { return _values[handle.index].bool_value; }
+    int32_t get(config_handle_t<int32_t> handle) const { return static_cast<int32_t>(_values[handle.index].int64_value); }
+    int64_t get(config_handle_t<int64_t> handle) const { return _values[handle.index].int64_value; }
+    uint32_t get(config_handle_t<uint32_t> handle) const { return static_cast<uint32_t>(_values[handle.index].uint64_value); }
+    uint64_t get(config_handle_t<uint64_t> handle) const { return _values[handle.index].uint64_value; }
+    const std::string& get(config_handle_t<std::string> handle) const { return _values[handle.index].string_value; }
+    const std::vector<std::string>& get(config_handle_t<std::vector<std::string> > handle) const { return _values[handle.index].string_values; }
+
+    /** 配置项是否在配置中存在，不存在时取到的是默认值 */
+    template <typename ValueType>
+    bool is_found(config_handle_t<ValueType> handle) const { return _values[handle.index].found; }
+
+private:
+    CConfigSnapshot(): _version(0) {}
+
+    struct config_value_t
+    {
+        bool found;
+        bool bool_value;
+        int64_t int64_value;
+        uint64_t uint64_value;
+        std::string string_value;
+        std::vector<std::string> string_values;
+    };
+
+private:
+    uint64_t _version;
+    std::vector<config_value_t> _values;
+};
+
+/***
+  * 配置变化的观察者
+  */
+class IConfigObserver
+{
+public:
+    virtual ~IConfigObserver() {}
+
+    /***
+      * 新快照发布后，在调用reload的线程中调用（watch_file时为监视线程），
+      * 此时get_snapshot已取得新快照，回调中不能再调用reload或add_*
+      * @changed_indexes: 值发生变化的配置项的下标，即config_handle_t的index
+      */
+    virtual void on_config_changed(const CConfigSnapshot* old_snapshot, const CConfigSnapshot* new_snapshot, const std::vector<uint32_t>& changed_indexes) = 0;
+};
+
+/***
+  * 预编译的配置缓存，启动时以add_*登记配置项（路径和名字只解析一次），得到句柄，
+  * reload时从IConfigReader读出所有配置项生成新的快照，有变化时以std::atomic_store整体替换（RCU），
+  * 读者拿着的旧快照在其shared_ptr释放后销毁，读和reload互不阻塞。
+  *
+  * 触发reload的方式：
+  * 1) watch_file：以inotify监视配置文件，文件被修改或被替换（编辑器以rename方式保存）后自动reload_file
+  * 2) zookeeper：在CZookeeperHelper的on_zookeeper_cache_changed中，由新数据构造IConfigReader后调用reload
+  *
+  * 使用示例：
+  * CConfigCache config_cache;
+  * const config_handle_t<int32_t> age = config_cache.add_int32("/A/B/C", "age", 0);
+  * config_cache.reload_file(config_file, "/etc/a.xml", &error_message);
+  * config_cache.watch_file(config_file, "/etc/a.xml");
+  *
+  * // 热路径，在各线程中（CConfigCursor为线程私有）
+  * CConfigCursor cursor(&config_cache);
+  * int32_t n = cursor->get(age);
+  */
+class CConfigCache
+{
+public:
+    CConfigCache();
+    ~CConfigCache();
+
+    /***
+      * 登记配置项，应在启动时一次性登记完
+      * @default_value: 配置中不存在或值不合法时的值
+      */
+    config_handle_t<bool> add_bool(const std::string& path, const std::string& name, bool default_value);
+    config_handle_t<int32_t> add_int32(const std::string& path, const std::string& name, int32_t default_value);
+    config_handle_t<int64_t> add_int64(const std::string& path, const std::string& name, int64_t default_value);
+    config_handle_t<uint32_t> add_uint32(const std::string& path, const std::string& name, uint32_t default_value);
+    config_handle_t<uint64_t> add_uint64(const std::string& path, const std::string& name, uint64_t default_value);
+    config_handle_t<std::string> add_string(const std::string& path, const std::string& name, const std::string& default_value);
+    config_handle_t<std::vector<std::string> > add_string_values(const std::string& path, const std::string& name);
+
+    /** 取得当前快照，需要多次读取同一视图时使用，热路径使用CConfigCursor */
+    std::shared_ptr<const CConfigSnapshot> get_snapshot() const;
+
+    /** 当前快照的版本号 */
+    uint64_t get_version() const { return __atomic_load_n(&_version, __ATOMIC_ACQUIRE); }
+
+    /***
+      * 从config_reader重新读取所有配置项，有变化时发布新快照并通知观察者
+      * @return: 值发生变化的配置项个数，为0时不发布新快照
+      */
+    int reload(IConfigReader* config_reader);
+
+    /***
+      * 打开配置文件后reload
+      * @return: 打开文件失败返回-1，error_message为出错信息，否则同reload
+      */
+    int reload_file(IConfigFile* config_file, const std::string& filepath, std::string* error_message);
+
+    /** 观察者的增删，观察者的生命周期由调用者管理 */
+    void add_observer(IConfigObserver* observer);
+    void remove_observer(IConfigObserver* observer);
+
+    /***
+      * 以inotify监视配置文件，变化后在监视线程中reload_file，
+      * 监视的是文件所在目录，因此文件被删除后重新创建也能继续
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void watch_file(IConfigFile* config_file, const std::string& filepath);
+    void stop_watching();
+
+    /** 调用reload的次数和因打开文件失败而reload失败的次数 */
+    uint64_t get_reload_number() const { return _reload_number; }
+    uint64_t get_reload_failure_number() const { return _reload_failure_number; }
+
+private:
+    enum value_type_t { type_bool, type_int32, type_int64, type_uint32, type_uint64, type_string, type_string_values };
+
+    struct item_t
+    {
+        std::string path;
+        std::string name;
+        value_type_t type;
+    };
+
+private:
+    uint32_t add_item(const std::string& path, const std::string& name, value_type_t type, const CConfigSnapshot::config_value_t& default_value);
+    int do_reload(IConfigReader* config_reader);
+    void publish(CConfigSnapshot* snapshot);
+    void read_item(IConfigReader* config_reader, uint32_t index, CConfigSnapshot::config_value_t* value) const;
+    void watch();
+    static bool equal_value(const CConfigSnapshot::config_value_t& lhs, const CConfigSnapshot::config_value_t& rhs);
+
+private:
+    CLock _lock; // 串行化登记和reload，读不需要
+    std::vector<item_t> _items;
+    std::vector<CConfigSnapshot::config_value_t> _default_values;
+    std::shared_ptr<const CConfigSnapshot> _snapshot; // 只以std::atomic_load/std::atomic_store访问
+    uint64_t _version;
+    std::vector<IConfigObserver*> _observers;
+    uint64_t _reload_number;
+    uint64_t _reload_failure_number;
+
+private:
+    IConfigFile* _config_file;
+    std::string _filepath;
+    int _inotify_fd;
+    int _stop_fd; // eventfd，用于通知监视线程退出
+    CThreadEngine* _watch_thread;
+};
+
+/***
+  * 线程私有的快照缓存，热路径上只比较一次版本号，
+  * 版本未变时直接返回缓存的快照指针，不碰shared_ptr的引用计数，
+  * 线程持有的旧快照在下一次访问时才释放
+  */
+class CConfigCursor
+{
+public:
+    explicit CConfigCursor(const CConfigCache* config_cache)
+        : _config_cache(config_cache), _version(0), _snapshot(config_cache->get_snapshot())
+    {
+        _version = _snapshot->get_version();
+    }
+
+    const CConfigSnapshot* get()
+    {
+        if (__builtin_expect(_config_cache->get_version() != _version, 0))
+        {
+            _snapshot = _config_cache->get_snapshot();
+            _version = _snapshot->get_version();
+        }
+        return _snapshot.get();
+    }
+
+    const CConfigSnapshot* operator ->()
+    {
+        return get();
+    }
+
+private:
+    const CConfigCache* _config_cache;
+    uint64_t _version;
+    std::shared_ptr<const CConfigSnapshot> _snapshot;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CONFIG_SNAPSHOT_H
@@ -0,0 +1,189 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_CURL_MULTI_H
+#define MOOON_SYS_CURL_MULTI_H
+#include "mooon/sys/lock.h"
+#include <map>
+#include <string>
+namespace mooon { namespace net {
+    class CEpollable;
+    class CEpoller;
+}} // namespace mooon::net
+SYS_NAMESPACE_BEGIN
+
+/***
+  * libcurl的共享缓存，被多个CCurlMulti（通常每个线程一个）共享，
+  * 包括DNS缓存、TLS会话缓存和连接缓存（libcurl 7.57.0及以上），
+  * 一个线程建立的连接和TLS会话，可被另一个线程复用，线程安全。
+  * 须在使用它的CCurlMulti都销毁之后才能销毁。
+  */
+class CCurlShare
+{
+public:
+    CCurlShare();
+    ~CCurlShare();
+
+    void* get_share() const { return _share; }
+
+public: // 供libcurl的加解锁回调使用
+    void lock(int data);
+    void unlock(int data);
+
+private:
+    void* _share;
+    CLock _locks[8]; // 按curl_lock_data分开加锁，减少DNS、连接和TLS会话之间的竞争
+};
+
+/***
+  * 一个由CCurlMulti驱动的HTTP传输，
+  * 响应头和响应体通过回调逐段交给调用者，不在内部累积。
+  *
+  * 使用示例：
+  * class CWebhook: public CCurlTransfer
+  * {
+  * public:
+  *     CWebhook(const std::string& url): CCurlTransfer(url) {}
+  *
+  * private:
+  *     virtual bool on_response_body(const char* data, size_t size) { _body.append(data, size); return true; }
+  *     virtual void on_finished(int errcode, const std::string& errmsg) { ...; delete this; }
+  * };
+  *
+  * CWebhook* webhook = new CWebhook("http://127.0.0.1/hook");
+  * webhook->set_post_data("{}");
+  * curl_multi.add(webhook);
+  */
+class CCurlTransfer
+{
+    friend class CCurlMulti;
+
+public:
+    /***
+      * @exception: 出错抛出CException异常
+      */
+    CCurlTransfer(const std::string& url, int data_timeout_seconds=2, int connect_timeout_seconds=2, bool enable_insecure=false);
+    virtual ~CCurlTransfer();
+
+    // 须在add到CCurlMulti之前调用
+    bool add_request_header(const std::string& name_value_pair);
+    void set_post_data(const std::string& data); // 设置后以POST方式请求，data被复制
+
+    const std::string& get_url() const { return _url; }
+    void* get_curl() const { return _curl; } // CURL*，可用来设置其它选项
+
+    // 取得响应的状态码，如：200、403、500等
+    int get_response_code() const;
+
+public: // 以下回调均在CCurlMulti::run中调用
+    // 每收到一行响应头调用一次，返回false则中止传输
+    virtual bool on_response_header(const char* data, size_t size) { return true; }
+
+    // 每收到一段响应体调用一次，返回false则中止传输
+    virtual bool on_response_body(const char* data, size_t size) = 0;
+
+    /***
+      * 传输结束时调用，包括成功、出错和被中止
+      * @errcode: CURLcode，为0表示成功
+      * 返回后CCurlMulti不再引用这个对象，可在其中delete this
+      */
+    virtual void on_finished(int errcode, const std::string& errmsg) = 0;
+
+private:
+    void* _curl;
+    void* _head_list;
+    std::string _url;
+    std::string _post_data;
+    std::string _error_buffer; // CURLOPT_ERRORBUFFER
+};
+
+/***
+  * 基于curl_multi的并发HTTP客户端，在一个线程中同时驱动多个传输，
+  * 传输的socket注册在net::CEpoller中，由libcurl的socket和timer回调驱动，
+  * 同一CCurlMulti中的传输共享连接缓存，完成的连接被后续到同一主机的传输复用。
+  *
+  * 非线程安全，add和run须在同一个线程中调用。
+  *
+  * 使用示例：
+  * CCurlShare curl_share;
+  * CCurlMulti curl_multi(&curl_share);
+  * curl_multi.create();
+  * curl_multi.add(new CWebhook(url));
+  * while (curl_multi.run(1000) > 0);
+  */
+class CCurlMulti
+{
+public:
+    /***
+      * @share: 可为NULL，不为NULL时新加入的传输使用它的缓存
+      * @max_host_connections: 到同一主机的最大连接数，为0表示不限制，超出的传输排队等待
+      * @max_total_connections: 总的最大连接数，为0表示不限制
+      */
+    CCurlMulti(CCurlShare* share=NULL, uint32_t max_host_connections=0, uint32_t max_total_connections=0);
+
+    /** 未完成的传输以CURLE_ABORTED_BY_CALLBACK结束 */
+    ~CCurlMulti();
+
+    /***
+      * @exception: 出错抛出CException或CSyscallException异常
+      */
+    void create(uint32_t epoll_size=1024);
+    void destroy();
+
+    /***
+      * 加入一个传输，开始执行
+      * @exception: 出错抛出CException异常
+      */
+    void add(CCurlTransfer* transfer);
+
+    /***
+      * 最多等待milliseconds毫秒，处理就绪的socket和到期的超时，
+      * 并对已结束的传输调用on_finished
+      * @return: 还未结束的传输数
+      * @exception: 出错抛出CException或CSyscallException异常
+      */
+    int run(uint32_t milliseconds);
+
+    /** 得到还未结束的传输数 */
+    int get_transfer_number() const { return static_cast<int>(_transfers.size()); }
+
+    /** 得到使用的CEpoller，可用wakeup从其它线程唤醒run */
+    net::CEpoller* get_epoller() const { return _epoller; }
+
+public: // 供libcurl的回调使用
+    void on_socket(int fd, int what, void* socketp);
+    void on_timer(long timeout_ms);
+
+private:
+    void socket_action(int fd, int ev_bitmask);
+    void check_finished();
+
+private:
+    CCurlShare* _share;
+    uint32_t _max_host_connections;
+    uint32_t _max_total_connections;
+    void* _multi;
+    net::CEpoller* _epoller;
+    int64_t _timer_expire; // libcurl要求超时处理的单调时钟毫秒数，为-1表示没有
+    int _running_number;
+    std::map<void*, CCurlTransfer*> _transfers; // key为CURL*
+    std::map<int, net::CEpollable*> _sockets;   // libcurl通过socket回调告知的socket
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CURL_MULTI_H
@@ -37,9 +37,27 @@ public:
     /** 将time_t值转换成类似于20160114这样的整数 */
     static uint32_t time2date(time_t t);
 
-    /** 将tm值转换成time_t值 */
+    /** 将tm值转换成time_t值，同mktime，但不修改tm */
     static time_t tm2time_t(const struct tm& tm);
 
+    /** 将time_t值转换成本地时间的tm值，同localtime_r */
+    static void time2tm(time_t t, struct tm* tm);
+
+    /***
+      * 公历日期和1970-01-01起的天数互相转换，与时区无关，1970-01-01之前的天数为负数
+      * month取值1~12，day取值1~31，day超出当月天数时顺延到下个月
+      */
+    static int64_t days_from_civil(int year, int month, int day);
+    static void civil_from_days(int64_t days, int* year, int* month, int* day);
+
+    /***
+      * time2tm、tm2time_t以及其它依赖本地时间的函数，第一次使用时按7天的间隔探测1970~2100年间的
+      * UTC偏移和夏令时切换点，之后只需查表和整数运算，不再调用localtime_r和mktime（它们都要取时区锁），
+      * 超出这个范围或落在夏令时切换的间隙和重叠中时，仍然使用localtime_r和mktime。
+      * 修改了TZ环境变量后，需调用reload_timezone重新探测，非线程安全
+      */
+    static void reload_timezone();
+
     /*
      * 求和datetime相隔的日期，比如days为1时表示date的后一天，days为-1表示date的前一天等
      * 调用者需要确保date格式为有效的日期，并满足格式YYYY-MM-DD hh:mm:ss，否则返回false
@@ -298,6 +316,16 @@ extern void get_formatted_current_datetime(char* datetime_buffer, size_t datetim
 // 如果with_microseconds为true，则返回为：YYYY-MM-DD hh:mm:ss/microseconds
 extern std::string get_formatted_current_datetime(bool with_microseconds=true);
 
+// 同get_formatted_current_datetime，格式和对datetime_buffer_size的要求也相同，但更快，适用于日志头等高频场景：
+// 每个线程缓存已格式化的“YYYY-MM-DD hh:mm:ss”，只有秒数变化时才重新调用localtime_r，
+// 微秒部分使用CStringUtils::uint64_toa转换。
+//
+// 如果time_thread不为NULL且with_microseconds为false，则秒数直接取自time_thread，不需要任何系统调用，
+// 但精度取决于time_thread的刷新间隔。
+// 返回写入datetime_buffer的字节数，不包括结尾符
+class CTimeThread;
+extern int get_cached_formatted_datetime(char* datetime_buffer, size_t datetime_buffer_size, bool with_microseconds=true, const CTimeThread* time_thread=NULL);
+
 // 格式为YYYY-MM-DD转成格式为YYYYMMDD的无符号4字节整数值，
 // 如果date是一个无效的值，则返回值为0
 extern uint32_t date2day(const std::string& date);
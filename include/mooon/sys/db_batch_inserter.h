@@ -0,0 +1,145 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_DB_BATCH_INSERTER_H
+#define MOOON_SYS_DB_BATCH_INSERTER_H
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/simple_db.h"
+#include <deque>
+SYS_NAMESPACE_BEGIN
+
+class CThreadEngine;
+
+/***
+  * 批量插入，将逐行加入的记录攒成一条多VALUES的INSERT语句再执行，
+  * 行数达到max_rows，或语句达到max_bytes（应小于服务端的max_allowed_packet）时自动flush。
+  *
+  * 默认在调用线程中同步执行；start_async后由后台线程执行，
+  * 调用线程只负责拼接下一批，积压的批数达到上限时add_row阻塞等待。
+  * 后台执行出错时，出错的批被丢弃，异常在之后的add_row或flush中抛出。
+  *
+  * 值均以字符串加单引号插入，由DB按字段类型转换，
+  * 后台线程运行期间，DBConnection不能再被其它地方使用（escape_string除外）。
+  *
+  * 使用示例：
+  * CDBBatchInserter inserter(&mysql, "test", "id,name");
+  * inserter.set_on_duplicate_update("name=VALUES(name)");
+  * inserter.set_max_bytes_by_server();
+  * inserter.start_async();
+  * for (...)
+  * {
+  *     DBRow row;
+  *     row.push_back(id);
+  *     row.push_back(name);
+  *     inserter.add_row(row);
+  * }
+  * inserter.flush();
+  */
+class CDBBatchInserter
+{
+public:
+    /***
+      * @table_name: 表名，可带库名
+      * @field_names: 以逗号分隔的字段名，为空表示全部字段
+      */
+    CDBBatchInserter(DBConnection* db_connection, const std::string& table_name, const std::string& field_names=std::string());
+
+    /** 等待已交给后台线程的批执行完，未flush的行被丢弃 */
+    ~CDBBatchInserter();
+
+    /** 以下须在加入第一行之前设置 */
+    void set_max_rows(uint32_t max_rows) { _max_rows = max_rows; }
+    void set_max_bytes(size_t max_bytes) { _max_bytes = max_bytes; }
+    void set_ignore(bool ignore) { _ignore = ignore; }
+
+    /***
+      * 设置ON DUPLICATE KEY UPDATE之后的部分，如：name=VALUES(name),n=n+VALUES(n)
+      */
+    void set_on_duplicate_update(const std::string& update_clause) { _update_clause = update_clause; }
+
+    /***
+      * 查询服务端的max_allowed_packet，并将max_bytes设为略小于它
+      * @exception: 出错抛出CDBException异常
+      */
+    void set_max_bytes_by_server();
+
+    /***
+      * 启动后台线程执行INSERT
+      * @max_pending_batches: 最多积压的待执行批数
+      */
+    void start_async(uint32_t max_pending_batches=2);
+
+    /***
+      * 加入一行，值的个数须和字段数一致
+      * @exception: 出错抛出CDBException异常，包括后台执行之前的批时出的错
+      */
+    void add_row(const DBRow& row);
+
+    /** 加入游标的当前行，值为NULL的字段插入NULL */
+    void add_row(const DBCursor& cursor);
+
+    /***
+      * 执行已加入的行，异步时等待所有积压的批执行完成
+      * @exception: 出错抛出CDBException异常
+      */
+    void flush();
+
+    /** 取得统计 */
+    uint64_t get_row_number() const { return _row_number; }
+    uint64_t get_batch_number() const;
+    uint64_t get_affected_rows() const;
+
+private:
+    void append_value(const char* data, size_t size);
+    void append_row();
+    void execute(const std::string& sql);
+    void submit();
+    void rethrow_async_error();
+    void run();
+
+private:
+    DBConnection* _db_connection;
+    std::string _insert_prefix;   /** INSERT INTO ... VALUES */
+    std::string _update_clause;
+    uint32_t _max_rows;
+    size_t _max_bytes;
+    bool _ignore;
+
+private:
+    std::string _sql;             /** 正在拼接的批 */
+    std::string _row;             /** 正在拼接的行 */
+    uint32_t _batch_rows;         /** 正在拼接的批中的行数 */
+    uint64_t _row_number;
+
+private:
+    mutable CLock _lock;          /** 保护以下成员 */
+    CEvent _not_empty;
+    CEvent _not_full;             /** 有批执行完成 */
+    CThreadEngine* _engine;
+    uint32_t _max_pending_batches;
+    std::deque<std::string*> _batches;
+    bool _executing;
+    bool _stop;
+    CDBException* _async_error;
+    uint64_t _batch_number;
+    uint64_t _affected_rows;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_DB_BATCH_INSERTER_H
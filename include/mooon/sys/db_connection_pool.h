@@ -0,0 +1,210 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_DB_CONNECTION_POOL_H
+#define MOOON_SYS_DB_CONNECTION_POOL_H
+#include "mooon/sys/concurrency_limiter.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/simple_db.h"
+#include <map>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * DB连接池的统计
+  */
+struct DBConnectionPoolStats
+{
+    uint32_t connection_number;     /** 当前连接数，包括空闲的、借出的和正在建立的 */
+    uint32_t idle_number;           /** 空闲连接数 */
+    uint32_t waiting_number;        /** 正在borrow中等待的调用数 */
+    uint64_t borrow_number;         /** 借出次数 */
+    uint64_t borrow_timeout_number; /** borrow超时返回NULL的次数 */
+    uint64_t limit_rejected_number; /** borrow因并发限制立即返回NULL的次数 */
+    uint64_t open_number;           /** 新建连接的次数 */
+    uint64_t open_failure_number;   /** 新建或重建连接失败的次数 */
+    uint64_t ping_number;           /** 借出前ping验证的次数 */
+    uint64_t ping_failure_number;   /** ping失败的次数，失败的连接被重建 */
+    uint64_t broken_number;         /** 以broken归还的次数 */
+    uint64_t wait_microseconds;     /** borrow累计等待的微秒数 */
+    uint64_t max_wait_microseconds; /** borrow单次最长等待的微秒数 */
+    uint64_t hold_microseconds;     /** 连接累计被借用的微秒数 */
+    uint64_t max_hold_microseconds; /** 连接单次最长被借用的微秒数 */
+};
+
+/***
+  * 线程安全的DB连接池，借出的连接同一时刻只被一个线程使用。
+  * 连接个数有上限，没有空闲连接且已达上限时，borrow最多等待指定的时长，
+  * 空闲连接按后进先出借出，以尽量复用少数热连接；
+  * 空闲超过idle_ping_seconds的连接，借出前先ping，失败的先reopen再借出，
+  * 避免每次借出都多一次往返，又不把被服务端关闭的连接交给调用者。
+  *
+  * 默认创建CMySQLConnection，可重写create_connection创建其它类型的连接。
+  *
+  * 使用示例：
+  * CDBConnectionPool db_pool;
+  * db_pool.set_host("127.0.0.1", 3306);
+  * db_pool.set_user("root", "");
+  * db_pool.set_db_name("test");
+  * db_pool.create(16);
+  *
+  * CDBConnectionPoolHelper db_connection(&db_pool, 1000);
+  * if (db_connection.get() != NULL)
+  * {
+  *     try
+  *     {
+  *         db_connection->update("update t set x=1 where id=%d", 2015);
+  *     }
+  *     catch (CDBException& db_error)
+  *     {
+  *         if (db_connection->is_lost_connection_exception(db_error))
+  *             db_connection.set_broken();
+  *     }
+  * }
+  */
+class CDBConnectionPool
+{
+public:
+    CDBConnectionPool();
+    virtual ~CDBConnectionPool();
+
+    /** 以下设置新建连接的参数，须在create之前调用 */
+    void set_host(const std::string& db_ip, uint16_t db_port);
+    void set_db_name(const std::string& db_name);
+    void set_user(const std::string& db_user, const std::string& db_password);
+    void set_charset(const std::string& charset);
+    void set_timeout_seconds(int connect_timeout_seconds, int read_timeout_seconds=-1, int write_timeout_seconds=-1);
+
+    /***
+      * 设置并发限制，所有权不转移，须在create之前设置，默认没有限制：
+      * 借出的连接数达到限制时borrow立即返回NULL，不等待，
+      * 以借用时长为耗时，以broken归还和borrow超时作为过载的信号，
+      * 使连接池在数据库变慢时少借出连接，而不是让所有调用者排队等到超时
+      */
+    void set_concurrency_limiter(CConcurrencyLimiter* limiter) { _limiter = limiter; }
+
+    /***
+      * 创建连接池
+      * @pool_size: 最多的连接数
+      * @idle_ping_seconds: 连接空闲超过这个秒数，借出前先ping验证，为0表示每次都验证
+      * @init_size: 预先建立的连接数
+      * @exception: 预先建立连接出错抛出CDBException异常
+      */
+    void create(uint32_t pool_size, uint32_t idle_ping_seconds=60, uint32_t init_size=0);
+
+    /***
+      * 关闭所有空闲连接，调用前须归还所有借出的连接
+      */
+    void destroy();
+
+    /***
+      * 借用一个连接
+      * @milliseconds: 没有空闲连接且已达上限时，等待归还的最长毫秒数，为0表示不等待
+      * @return: 超时或被并发限制拒绝时返回NULL
+      * @exception: 建立连接出错抛出CDBException异常
+      */
+    DBConnection* borrow(uint32_t milliseconds=1000);
+
+    /***
+      * 归还借用的连接
+      * @broken: 连接是否已不可用（如is_lost_connection_exception），为true时关闭并释放
+      */
+    void pay_back(DBConnection* db_connection, bool broken=false);
+
+    /** 取得统计 */
+    void get_stats(DBConnectionPoolStats* stats) const;
+
+private:
+    /** 创建一个未打开的连接，默认为CMySQLConnection */
+    virtual DBConnection* create_connection();
+
+private:
+    struct IdleConnection
+    {
+        DBConnection* db_connection;
+        uint64_t idle_time; /** 开始空闲的单调时钟微秒数 */
+    };
+
+    struct BusyConnection
+    {
+        uint64_t borrow_time; /** 借出时的单调时钟微秒数 */
+        CLimitTicket ticket;
+    };
+
+private:
+    DBConnection* borrow_connection(uint32_t milliseconds, const CLimitTicket& ticket);
+    DBConnection* open_connection();
+    void validate_connection(DBConnection* db_connection, uint64_t idle_time);
+    void release_connection(DBConnection* db_connection);
+
+private:
+    std::string _db_ip;
+    uint16_t _db_port;
+    std::string _db_name;
+    std::string _db_user;
+    std::string _db_password;
+    std::string _charset;
+    int _connect_timeout_seconds;
+    int _read_timeout_seconds;
+    int _write_timeout_seconds;
+    uint32_t _pool_size;
+    uint64_t _idle_ping_microseconds;
+    CConcurrencyLimiter* _limiter;
+
+private:
+    mutable CLock _lock;
+    CEvent _event; /** 有连接归还或连接数减少 */
+    std::vector<IdleConnection> _idle_connections; /** 后面的是最近归还的 */
+    std::map<DBConnection*, BusyConnection> _busy_connections;
+    uint32_t _connection_number;
+    DBConnectionPoolStats _stats; /** 均在持有_lock时更新 */
+};
+
+/***
+  * 借用连接的帮助类，析构时自动归还
+  */
+class CDBConnectionPoolHelper
+{
+public:
+    CDBConnectionPoolHelper(CDBConnectionPool* db_pool, uint32_t milliseconds=1000)
+        : _db_pool(db_pool), _broken(false)
+    {
+        _db_connection = db_pool->borrow(milliseconds);
+    }
+
+    ~CDBConnectionPoolHelper()
+    {
+        if (_db_connection != NULL)
+            _db_pool->pay_back(_db_connection, _broken);
+    }
+
+    /** 标记连接已不可用，归还时关闭 */
+    void set_broken() { _broken = true; }
+
+    DBConnection* get() const { return _db_connection; }
+    DBConnection* operator ->() const { return _db_connection; }
+
+private:
+    CDBConnectionPool* _db_pool;
+    DBConnection* _db_connection;
+    bool _broken;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_DB_CONNECTION_POOL_H
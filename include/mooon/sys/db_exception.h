@@ -37,7 +37,9 @@ enum
 {
     DB_NOT_SUPPORTED,       // 不支持的功能
     DB_ERROR_TOO_MANY_COLS, // 查询结果返回超出预期的列数（即返回的字段数过多）
-    DB_ERROR_TOO_MANY_ROWS  // 查询结果返回超出预期的行数
+    DB_ERROR_TOO_MANY_ROWS, // 查询结果返回超出预期的行数
+    DB_ERROR_BORROW_TIMEOUT,// 从连接池借连接超时
+    DB_ERROR_SHARED_QUERY   // 等待的其它线程的同一查询出错
 };
 
 class CDBException: public utils::CException
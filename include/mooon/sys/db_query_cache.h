@@ -0,0 +1,73 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_DB_QUERY_CACHE_H
+#define MOOON_SYS_DB_QUERY_CACHE_H
+#include "mooon/sys/cache.h"
+#include "mooon/sys/db_connection_pool.h"
+#include <memory>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 以SQL为键缓存查询结果，用于读多写少的配置表和字典表：
+  * 缺失时从CDBConnectionPool借连接查询，同一条SQL的并发缺失只查询一次，
+  * 结果以只读的std::shared_ptr共享，不复制整张表。
+  *
+  * 使用示例：
+  * mooon::sys::CDBQueryCache query_cache(&db_pool, policy, "config");
+  * std::shared_ptr<const mooon::sys::DBTable> table = query_cache.query("SELECT k,v FROM t_config", 60000);
+  */
+class CDBQueryCache
+{
+public:
+    /***
+      * @policy: 缓存的参数，ttl_milliseconds为query未指定时的默认存活毫秒数
+      * @metrics_name: 非空时计数器为cache.<名字>.hits等
+      * @borrow_milliseconds: 借连接的最长等待毫秒数
+      */
+    CDBQueryCache(CDBConnectionPool* db_pool, const cache_policy_t& policy=cache_policy_t(),
+                  const std::string& metrics_name=std::string(), uint32_t borrow_milliseconds=1000);
+
+    /***
+      * 取得查询结果，不在缓存中时查询DB
+      * @ttl_milliseconds: 结果的存活毫秒数，为0时使用cache_policy_t::ttl_milliseconds
+      * @exception: 借连接超时或查询出错抛出CDBException异常，
+      *  等待的其它线程的查询出错时，等待者也抛出CDBException异常
+      */
+    std::shared_ptr<const DBTable> query(const std::string& sql, uint32_t ttl_milliseconds=0);
+
+    /** 使一条SQL的结果失效，如更新了表之后 */
+    bool invalidate(const std::string& sql);
+
+    /** 使所有结果失效 */
+    void clear();
+
+    void get_stats(cache_stats_t* stats) const { _cache.get_stats(stats); }
+
+private:
+    struct Loader;
+    bool load(const std::string& sql, std::shared_ptr<const DBTable>* table);
+
+private:
+    CDBConnectionPool* _db_pool;
+    const uint32_t _borrow_milliseconds;
+    CConcurrentCache<std::string, std::shared_ptr<const DBTable> > _cache;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_DB_QUERY_CACHE_H
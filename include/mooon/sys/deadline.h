@@ -0,0 +1,102 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_DEADLINE_H
+#define MOOON_SYS_DEADLINE_H
+#include "mooon/sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 基于单调时钟（CClock::get_nanoseconds）的绝对截止时间，
+  * 用于让一次完整的操作（如full_receive中的多次poll和recv）共用一个超时，
+  * 而不是每一步各用一个完整的超时，使总的时长可能是超时的若干倍。
+  *
+  * 默认构造的为无限期，不会过期。
+  * 通过CDeadlineScope可以设置本线程当前的截止时间，嵌套调用（如CDataChannel::full_receive、
+  * thrift、libssh2和curl的超时）据此收紧自己的超时，不必逐层传递参数。
+  *
+  * 使用示例：
+  * mooon::sys::CDeadline deadline(200); // 整个请求最多200毫秒
+  * client.full_send(request, request_size, deadline);
+  * client.full_receive(response, response_size, deadline);
+  */
+class CDeadline
+{
+public:
+    /** 无限期 */
+    CDeadline(): _nanoseconds(0) {}
+
+    /** 从现在起milliseconds毫秒之后截止 */
+    explicit CDeadline(uint32_t milliseconds);
+
+    /** 由CClock::get_nanoseconds的绝对值构造，为0表示无限期 */
+    static CDeadline from_nanoseconds(uint64_t nanoseconds);
+
+    /** 得到两者中较早的 */
+    static CDeadline earlier(const CDeadline& a, const CDeadline& b);
+
+    /***
+      * 得到本线程当前的截止时间，即最内层CDeadlineScope设置的，
+      * 没有CDeadlineScope时为无限期
+      */
+    static CDeadline get_current();
+
+    bool is_infinite() const { return 0 == _nanoseconds; }
+    bool is_expired() const;
+
+    /** 得到截止时间的CClock::get_nanoseconds值，无限期时为0 */
+    uint64_t get_nanoseconds() const { return _nanoseconds; }
+
+    /***
+      * 得到剩余的毫秒数，不足1毫秒的向上取整，使剩余的时间不会因被截断而提前被当作超时，
+      * 已过期返回0，无限期返回-1，可直接作为poll和epoll_wait的超时
+      */
+    int get_remaining_milliseconds() const;
+
+    /***
+      * 以剩余时间收紧一个毫秒数的超时，用于向不接受截止时间的接口传递剩余时间
+      * @milliseconds: 原来的超时，为0表示原来不超时
+      * @return: 无限期时返回milliseconds，否则返回milliseconds和剩余时间中较小的，
+      *          至少为1（通常0表示不超时，已过期时也不能返回0）
+      */
+    uint32_t clamp_milliseconds(uint32_t milliseconds) const;
+
+private:
+    uint64_t _nanoseconds;
+};
+
+/***
+  * 在作用域内设置本线程当前的截止时间（见CDeadline::get_current），析构时恢复，
+  * 可以嵌套，内层的不会比外层的晚：取设置的和外层的中较早的
+  */
+class CDeadlineScope
+{
+public:
+    explicit CDeadlineScope(const CDeadline& deadline);
+    ~CDeadlineScope();
+
+private:
+    CDeadlineScope(const CDeadlineScope&);
+    CDeadlineScope& operator =(const CDeadlineScope&);
+
+private:
+    uint64_t _previous_nanoseconds;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_DEADLINE_H
@@ -66,5 +66,76 @@ public:
     static void create_directory_byfilepath(const char* filepath, mode_t permissions=DIRECTORY_DEFAULT_PERM);
 };
 
+// CDirWalker遍历到的一项，只在回调期间有效
+struct dir_entry_t
+{
+    const std::string* dirpath; // 所在目录的路径
+    const char* name;           // 不含路径的名字
+    unsigned char type;         // DT_REG、DT_DIR、DT_LNK等，文件系统不提供时以fstatat取得
+    const struct stat* st;      // 未要求stat时为NULL（type以fstatat取得时仍有）
+    int dir_fd;                 // 所在目录的句柄，可用于unlinkat等*at系统调用
+};
+
+// 遍历目录的回调，会被多个线程同时调用
+class IDirVisitor
+{
+public:
+    virtual ~IDirVisitor() {}
+
+    // 遇到子目录，返回false则跳过整个子目录
+    virtual bool enter_directory(const dir_entry_t& entry) { return true; }
+
+    // 遇到非目录的项
+    virtual void on_entry(const dir_entry_t& entry) = 0;
+
+    // 打开或读取目录出错，如无权限或目录已被删除，之后继续遍历其它目录
+    virtual void on_error(const std::string& dirpath, int errcode) {}
+};
+
+/***
+  * 多线程递归遍历目录，以getdents64大块读取目录项，以fstatat相对于目录句柄取属性，
+  * 不需要属性时只用目录项自带的类型（d_type），大目录下可省去每项一次stat。
+  * 每个线程有自己的待遍历子目录队列，从自己队列的尾部取（深度优先，局部性好），
+  * 空闲时从其它线程队列的头部窃取，所以单个目录下有大量子目录时也能均衡。
+  * 不跟随符号链接。
+  */
+class CDirWalker
+{
+public:
+    // num_threads 遍历的线程数，包括调用walk的线程
+    // need_stat 是否对每一项调用fstatat，为false时dir_entry_t的st通常为NULL
+    CDirWalker(int num_threads=4, bool need_stat=false);
+    ~CDirWalker();
+
+    /***
+      * 遍历dirpath下的所有项（不含dirpath自身），返回时已遍历完
+      * @exception 打开dirpath出错时抛出sys::CSyscallException异常
+      */
+    void walk(const std::string& dirpath, IDirVisitor* visitor);
+
+    uint64_t get_dir_number() const { return _dir_number; }     // 遍历到的子目录数
+    uint64_t get_entry_number() const { return _entry_number; } // 遍历到的非目录项数
+    uint64_t get_error_number() const { return _error_number; }
+
+private:
+    struct WalkQueue;
+
+private:
+    void work(int index);
+    bool take_directory(int index, std::string* dirpath);
+    void walk_directory(int index, const std::string& dirpath, char* buffer, size_t buffer_size);
+    void push_directories(int index, std::vector<std::string>* dirpaths);
+
+private:
+    const int _num_threads;
+    const bool _need_stat;
+    IDirVisitor* _visitor;
+    std::vector<WalkQueue*> _queues;
+    int64_t _pending_number; // 已入队或正在遍历的目录数，为0时结束
+    uint64_t _dir_number;
+    uint64_t _entry_number;
+    uint64_t _error_number;
+};
+
 SYS_NAMESPACE_END
 #endif // MOOON_SYS_DIR_UTILS_H
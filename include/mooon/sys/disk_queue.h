@@ -0,0 +1,191 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_DISK_QUEUE_H
+#define MOOON_SYS_DISK_QUEUE_H
+#include "mooon/sys/mmap.h"
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 磁盘队列的策略，见CDiskQueue
+  * 几个sync条件任一满足即刷盘，都为0时只在调用sync和close时刷盘
+  */
+struct CDiskQueuePolicy
+{
+    uint32_t segment_size;      /** 每个段文件的大小，会向上对齐到页，一条记录不能超过它（减去8字节的记录头） */
+    uint32_t max_segments;      /** 最多的段数，达到后push返回false（满），0表示不限 */
+    uint32_t spare_segments;    /** 消费完的段最多保留几个备用，新建段时改名复用，不必重新分配磁盘空间 */
+    uint32_t sync_records;      /** 每写入这么多条记录刷一次盘 */
+    uint32_t sync_bytes;        /** 每写入这么多字节刷一次盘 */
+    uint32_t sync_milliseconds; /** 距上次刷盘超过这么多毫秒时，下一次写入后刷盘 */
+
+    CDiskQueuePolicy()
+        : segment_size(64*1024*1024), max_segments(0), spare_segments(2),
+          sync_records(0), sync_bytes(4*1024*1024), sync_milliseconds(1000)
+    {
+    }
+};
+
+/***
+  * 基于内存映射的磁盘队列（只追加），用于后端（Kafka、Redis等）不可用时暂存数据，恢复后再重放，
+  * 既不必阻塞生产者，也不必丢弃数据。
+  *
+  * 队列是一个目录，其中的段文件名为20位的段序号加“.dq”，每个段创建时即以posix_fallocate分配磁盘空间
+  * （避免磁盘满时写映射区触发SIGBUS），整个映射到内存，写入和读出都直接在映射区中进行，不复制：
+  * reserve返回映射区中的位置，写入后commit；front返回指向映射区的视图。
+  *
+  * 每条记录为8字节的记录头（长度和CRC32C）加数据，按8字节对齐，CRC的初始值含段序号，
+  * 因此复用的段中残留的旧记录不会被当作有效记录。记录头在数据之后写入，
+  * 打开时扫描各段，遇到第一条不完整或校验失败的记录即为该段的结尾。
+  *
+  * 消费位置（段序号和段内偏移）在刷盘时写入目录下的offset文件，重新打开后从该位置继续，
+  * 即至少一次：上次刷盘后已pop的记录会被再次读出。
+  * 消费位置越过的段在刷盘后被回收（改名为备用段或删除）。
+  *
+  * 写入映射区的数据在进程崩溃时不会丢失（由内核写回），刷盘（msync和fdatasync）只防止系统崩溃和掉电。
+  * 非线程安全，读写须在同一个线程中，或由调用者加锁。
+  *
+  * 使用示例：
+  * CDiskQueue queue;
+  * queue.open("/data/spool");
+  * queue.push(data, size);
+  * std::string_view record;
+  * while (queue.front(&record)) { ...; queue.pop(); }
+  */
+class CDiskQueue
+{
+public:
+    CDiskQueue();
+    ~CDiskQueue();
+
+    /***
+      * 打开队列目录，不存在时创建，之前打开的先被关闭
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void open(const std::string& directory, const CDiskQueuePolicy& policy=CDiskQueuePolicy());
+
+    /***
+      * 刷盘并关闭，之前得到的视图和reserve的位置变为无效
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void close();
+
+    bool is_open() const { return !_directory.empty(); }
+
+    /***
+      * 预留size字节，返回映射区中的位置，写入数据后调用commit，commit前不能再次reserve
+      * @return: 达到max_segments时返回NULL
+      * @exception: size超过段大小时抛出CException异常，创建段出错时抛出CSyscallException异常
+      */
+    char* reserve(uint32_t size);
+
+    /***
+      * 提交reserve的数据，之后才对front可见，满足策略时刷盘
+      * @size: 实际写入的字节数，不能大于reserve时的
+      */
+    void commit(uint32_t size);
+
+    /** 写入一条记录，即reserve、复制和commit，满时返回false */
+    bool push(const void* data, uint32_t size);
+
+    /***
+      * 得到队首的记录，不出队，视图指向映射区，在该记录被回收（pop后再刷盘）或close前有效
+      * @return: 队列为空时返回false
+      */
+    bool front(std::string_view* record);
+
+    /***
+      * 从队首起取最多max_number条记录，不出队，视图的有效期同front
+      * @return: 取得的记录数
+      */
+    size_t peek(std::vector<std::string_view>* records, size_t max_number);
+
+    /** 出队number条记录，不能多于队列中的 */
+    void pop(size_t number=1);
+
+    /***
+      * 刷盘：将写入的数据和消费位置写到磁盘，并回收消费完的段
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void sync();
+
+    bool empty() const { return 0 == _record_number; }
+
+    /** 队列中（未出队）的记录数和数据字节数 */
+    uint64_t get_record_number() const { return _record_number; }
+    uint64_t get_bytes() const { return _bytes; }
+
+    /** 段数，包括已消费完但还未回收的 */
+    uint32_t get_segment_number() const { return static_cast<uint32_t>(_segments.size()); }
+
+private:
+    struct Segment
+    {
+        uint64_t seq;
+        mmap_t* mmap;
+        uint32_t end;    // 最后一条有效记录之后的偏移
+        uint32_t synced; // 已刷盘的偏移
+    };
+
+    CDiskQueue(const CDiskQueue&);
+    CDiskQueue& operator =(const CDiskQueue&);
+
+    void release();
+    std::string get_segment_path(uint64_t seq) const;
+    std::string get_spare_path(uint64_t seq) const;
+    void add_segment();
+    void recover_segment(struct Segment* segment);
+    void load_offset();
+    void save_offset();
+    void recycle_segments();
+    void sync_segment(struct Segment* segment);
+
+    // 读位置上有记录时返回true，读完的段跳到下一个段
+    bool locate_front();
+
+    static uint32_t get_checksum(uint64_t seq, const char* data, uint32_t size);
+
+private:
+    std::string _directory;
+    CDiskQueuePolicy _policy;
+    std::deque<struct Segment> _segments;
+    std::vector<uint64_t> _spare_seqs; // 备用段的序号（文件名中的）
+    uint64_t _next_seq;
+    int _offset_fd;
+    bool _offset_dirty;
+
+    // 读位置
+    size_t _read_index; // 在_segments中的下标
+    uint32_t _read_offset;
+    uint64_t _record_number;
+    uint64_t _bytes;
+
+    // 写入
+    char* _reserved;
+    uint32_t _reserved_size;
+    uint32_t _unsynced_records;
+    uint32_t _unsynced_bytes;
+    uint64_t _sync_milliseconds;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_DISK_QUEUE_H
@@ -31,9 +31,12 @@ class CEvent
 public:
     /***
       * 构造通知事件实例
+      * @use_monotonic_clock: timed_wait是否按CLOCK_MONOTONIC计时，
+      *  为true时不受系统时间调整（如NTP或手工修改时间）影响，为false时按CLOCK_REALTIME计时；
+      *  只需少量等待者且不须持锁时，也可用更轻量的CFutexEvent（见futex_event.h）
       * @exception: 出错抛出CSyscallException异常，通常可不捕获此异常
       */
-    CEvent();
+    CEvent(bool use_monotonic_clock=true);
     ~CEvent() throw ();
 
     /***
@@ -63,9 +66,17 @@ public:
       * @exception: 出错抛出CSyscallException异常，通常可不捕获此异常
       */
     void broadcast();
+
+    /***
+      * 唤醒最多n个进入等待状态的线程，如一次放入n个元素时，
+      * 避免broadcast唤醒全部等待者后大多数又重新进入等待
+      * @exception: 出错抛出CSyscallException异常，通常可不捕获此异常
+      */
+    void wake_n(uint32_t n);
     
 private:
     pthread_cond_t _cond;
+    clockid_t _clock_id; // timed_wait的绝对时间所用的时钟，和条件变量的属性一致
 };
 
 SYS_NAMESPACE_END
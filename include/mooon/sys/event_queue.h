@@ -19,7 +19,13 @@
 #ifndef MOOON_SYS_EVENT_QUEUE_H
 #define MOOON_SYS_EVENT_QUEUE_H
 #include "mooon/sys/event.h"
+#include "mooon/sys/futex_event.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/queue_delay.h"
+#include "mooon/sys/spin_lock.h"
+#include <algorithm>
 #include <list>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
 // 让std::list可直接应用在CEventQueue
@@ -57,6 +63,13 @@ public:
         return elem;
     }
 
+    DataType pop_back()
+    {
+        DataType elem = _list.back();
+        _list.pop_back();
+        return elem;
+    }
+
     void push_back(DataType elem)
     {
         _list.push_back(elem);
@@ -81,6 +94,8 @@ private:
   * 特性1: 如果队列为空，则可等待队列有数据时
   * 特性2: 如果队列已满，则可等待队列为非满时
   * RawQueueClass为原始队列类名，如utils::CArrayQueue
+  * EventClass为通知事件类名，默认为CEvent，也可为CFutexEvent（没有等待者时唤醒不进入内核）
+  * 特性3: 可以记录元素的逗留时间，并在过载时丢弃陈旧的元素或改为后进先出，见enable_delay_control
   *
   * 使用示例1：
   * mooon::sys::CEventQueue<mooon::utils::CArrayQueue<int> > _queue;
@@ -93,6 +108,9 @@ private:
   * 使用示例2：
   * mooon::sys::CEventQueue<mooon::sys::CEventQueueAdapterForList<int> > _queue;
   *
+  * 使用示例3：
+  * mooon::sys::CEventQueue<mooon::utils::CArrayQueue<int>, mooon::sys::CFutexEvent> _queue;
+  *
   * 特别注意：
   * 如果一个线程即消费队列，又会往队列添加数据，有可能造成死锁或无法push成功，
   * 原因是线程在push时，队列可能已满，由于它自己才是消费者，导致队列无法解除满状态。
@@ -100,7 +118,7 @@ private:
   * 1.保持队列足够大到可以避免这个问题发生
   * 2.或增加线程私有队列，对于线程自己需要push的，放到它的私有队列中。
   */
-template <class RawQueueClass>
+template <class RawQueueClass, class EventClass=CEvent>
 class CEventQueue
 {       
 public:
@@ -121,7 +139,44 @@ public:
         ,_push_milliseconds(push_milliseconds)
         ,_pop_waiter_number(0)
         ,_push_waiter_number(0)
+        ,_spin_number(0)
+        ,_size(0)
+        ,_delay_controller(NULL)
+        ,_shedder(NULL)
+    {
+        _lock.set_contention_name("event_queue");
+    }
+
+    ~CEventQueue()
+    {
+        delete _delay_controller;
+    }
+
+    /***
+      * 设置进入等待前的自旋次数，默认为0即不自旋
+      * 队列只是短暂为空（或满）时，自旋可以避免睡眠和唤醒的两次上下文切换，
+      * 但自旋期间占用CPU，只适合生产者和消费者都是活跃线程且CPU充足的情况
+      */
+    void set_spin_number(uint32_t spin_number) { _spin_number = spin_number; }
+
+    /***
+      * 开启延迟控制（见CQueueDelayController），须在使用队列之前调用：
+      * 入队时记录时间，出队时将逗留时间计入queue.<name>.sojourn_ns，
+      * 过载时若设置了policy.adaptive_lifo则从队尾出队，
+      * 若shedder不为NULL，逗留过久的元素在出队时被丢弃并交给shedder，计入queue.<name>.shed
+      * RawQueueClass须有pop_back（utils::CArrayQueue和CEventQueueAdapterForList都有）
+      */
+    void enable_delay_control(const CQueueDelayPolicy& policy, IQueueShedder<DataType>* shedder=NULL)
+    {
+        delete _delay_controller;
+        _delay_controller = new CQueueDelayController(policy, _raw_queue.capacity());
+        _shedder = shedder;
+    }
+
+    /** 得到逗留时间的直方图，未开启延迟控制时返回NULL */
+    CLatencyHistogram* get_sojourn_histogram() const
     {
+        return (NULL == _delay_controller)? NULL: _delay_controller->get_sojourn_histogram();
     }
 
     /** 判断队列是否已满 */
@@ -160,21 +215,8 @@ public:
       */
     bool pop_front(DataType& elem) 
 	{
-        LockHelper<CLock> lock(_lock);
-        while (_raw_queue.is_empty())
-        {
-            // 如果不等待，则立即返回
-            if (0 == _pop_milliseconds) return false;
-            // 使用助手类管理计数，因为timed_wait可能抛异常
-            utils::CountHelper<volatile int> ch(_pop_waiter_number);
-            
-            // 超时则立即返回
-            if (!_event.timed_wait(_lock, _pop_milliseconds)) return false;
-        }
-
-        elem = _raw_queue.pop_front();
-        if (_push_waiter_number > 0) _event.broadcast();
-        return true;
+        uint32_t array_size = 1;
+        return pop_front_batch(&elem, array_size);
     }
 
     bool pop_front()
@@ -182,6 +224,29 @@ public:
         DataType elem;
         return pop_front(elem);
     }
+
+    /***
+      * 一次加锁弹出多个元素，队列为空时和pop_front一样等待，不为空时取走已有的，不等凑满
+      * @elem_array: 存储弹出的队首元素数组
+      * @array_size: 输入和输出参数，输入为elem_array的大小，输出为实际弹出的元素个数
+      * @return: 如果至少弹出一个则返回true，否则（队列为空或超时）返回false
+      * @exception: 可能抛出CSyscallExceptoin异常，其它异常和RawQueue有关
+      */
+    bool pop_front_batch(DataType* elem_array, uint32_t& array_size)
+    {
+        const uint32_t max_size = array_size;
+        array_size = 0;
+        if (0 == max_size) return false;
+        if ((_spin_number > 0) && (_pop_milliseconds > 0))
+            spin_wait(0);
+
+        // 丢弃的元素在锁外交给shedder
+        std::vector<std::pair<DataType, uint64_t> > shed_elems;
+        const bool popped = do_pop_front_batch(elem_array, max_size, array_size, &shed_elems);
+        for (typename std::vector<std::pair<DataType, uint64_t> >::size_type i=0; i<shed_elems.size(); ++i)
+            _shedder->on_shed(shed_elems[i].first, shed_elems[i].second);
+        return popped;
+    }
     
 	/***
       * 往队尾插入一个元素
@@ -191,6 +256,26 @@ public:
       */
     bool push_back(DataType elem) 
 	{
+        uint32_t array_size = 1;
+        return push_back_batch(&elem, array_size);
+    }
+
+    /***
+      * 一次加锁插入多个元素，队列满时和push_back一样等待，有空位时放入放得下的，不等全部放下
+      * @elem_array: 需要插入队尾的数据数组
+      * @array_size: 输入和输出参数，输入为elem_array的大小，输出为实际插入的元素个数，
+      *              可能少于输入，调用者需要重试剩余的
+      * @return: 如果至少插入一个则返回true，否则（队列满或超时）返回false
+      * @exception: 可能抛出CSyscallExceptoin异常，其它异常和RawQueue有关
+      */
+    bool push_back_batch(const DataType* elem_array, uint32_t& array_size)
+    {
+        const uint32_t max_size = array_size;
+        array_size = 0;
+        if (0 == max_size) return false;
+        if ((_spin_number > 0) && (_push_milliseconds > 0))
+            spin_wait(_raw_queue.capacity());
+
         LockHelper<CLock> lock(_lock);
         while (_raw_queue.is_full())
         {
@@ -199,12 +284,28 @@ public:
             // 使用助手类管理计数，因为timed_wait可能抛异常
             utils::CountHelper<volatile int> ch(_push_waiter_number);
 
-            // 超时则立即返回
-            if (!_event.timed_wait(_lock, _push_milliseconds)) return false;
+            // 超时则立即返回，但超时和被唤醒可能同时发生，这时有空位就不算超时
+            if (!_push_event.timed_wait(_lock, _push_milliseconds))
+            {
+                if (!_raw_queue.is_full()) break;
+                get_push_timeout_counter()->inc();
+                return false;
+            }
+        }
+
+        while ((array_size < max_size) && !_raw_queue.is_full())
+            _raw_queue.push_back(elem_array[array_size++]);
+        if (_delay_controller != NULL)
+        {
+            const uint64_t now_nanoseconds = CClock::get_nanoseconds();
+            for (uint32_t i=0; i<array_size; ++i)
+                _delay_controller->on_push(now_nanoseconds);
         }
+        __atomic_store_n(&_size, _raw_queue.size(), __ATOMIC_RELAXED);
 
-        _raw_queue.push_back(elem);
-        if (_pop_waiter_number > 0) _event.broadcast();
+        // 只有在有等待者时才发信号，放入几个元素就最多唤醒几个
+        if (_pop_waiter_number > 0)
+            _pop_event.wake_n(std::min<uint32_t>(array_size, _pop_waiter_number));
         return true;
     }
 
@@ -215,8 +316,86 @@ public:
 		return _raw_queue.size(); 
 	}
 
+private:
+    bool do_pop_front_batch(DataType* elem_array, uint32_t max_size, uint32_t& array_size, std::vector<std::pair<DataType, uint64_t> >* shed_elems)
+    {
+        LockHelper<CLock> lock(_lock);
+        do
+        {
+            while (_raw_queue.is_empty())
+            {
+                // 如果不等待，则立即返回
+                if (0 == _pop_milliseconds) return false;
+                // 使用助手类管理计数，因为timed_wait可能抛异常
+                utils::CountHelper<volatile int> ch(_pop_waiter_number);
+
+                // 超时则立即返回，但超时和被唤醒可能同时发生，这时有数据就不算超时
+                if (!_pop_event.timed_wait(_lock, _pop_milliseconds))
+                {
+                    if (!_raw_queue.is_empty()) break;
+                    get_pop_timeout_counter()->inc();
+                    return false;
+                }
+            }
+
+            const uint32_t shed_number = static_cast<uint32_t>(shed_elems->size());
+            if (NULL == _delay_controller)
+            {
+                while ((array_size < max_size) && !_raw_queue.is_empty())
+                    elem_array[array_size++] = _raw_queue.pop_front();
+            }
+            else
+            {
+                const uint64_t now_nanoseconds = CClock::get_nanoseconds();
+                while ((_shedder != NULL) && _delay_controller->should_shed_head(now_nanoseconds))
+                {
+                    const DataType elem = _raw_queue.pop_front();
+                    shed_elems->push_back(std::make_pair(elem, _delay_controller->on_shed_head(now_nanoseconds)));
+                }
+
+                const bool lifo = _delay_controller->use_lifo(now_nanoseconds);
+                while ((array_size < max_size) && !_raw_queue.is_empty())
+                {
+                    elem_array[array_size++] = lifo? _raw_queue.pop_back(): _raw_queue.pop_front();
+                    (void)_delay_controller->on_pop(now_nanoseconds, lifo);
+                }
+            }
+            __atomic_store_n(&_size, _raw_queue.size(), __ATOMIC_RELAXED);
+
+            // 只有在有等待者时才发信号，空出一个位置只需唤醒一个
+            const uint32_t freed_number = array_size + static_cast<uint32_t>(shed_elems->size()) - shed_number;
+            if ((_push_waiter_number > 0) && (freed_number > 0))
+                _push_event.wake_n(std::min<uint32_t>(freed_number, _push_waiter_number));
+        } while (0 == array_size); // 全部被丢弃时继续等待
+
+        return true;
+    }
+
+private:
+    // 不加锁地自旋，直到元素个数不再等于busy_size（0表示空，容量表示满）或自旋次数用完，
+    // _size只是提示，自旋结束后仍然在锁内判断
+    void spin_wait(uint32_t busy_size) const
+    {
+        for (uint32_t i=0; (i<_spin_number) && (__atomic_load_n(&_size, __ATOMIC_RELAXED) == busy_size); ++i)
+            SPIN_LOCK_PAUSE();
+    }
+
+    // 所有事件队列共用的度量，只在等待超时时更新
+    static CCounter* get_pop_timeout_counter()
+    {
+        static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("event_queue.pop_timeout");
+        return counter;
+    }
+
+    static CCounter* get_push_timeout_counter()
+    {
+        static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("event_queue.push_timeout");
+        return counter;
+    }
+
 private:        
-    CEvent _event;
+    EventClass _pop_event;         /** 等待队列有数据 */
+    EventClass _push_event;        /** 等待队列有空位置 */
     mutable CLock _lock;    
     RawQueueClass _raw_queue;      /** 原始队列 */
 
@@ -225,6 +404,12 @@ private:
     uint32_t _push_milliseconds;   /** 入队时等待超时毫秒数 */
     volatile int _pop_waiter_number;  /** 等待队列有数据的线程个数 */
     volatile int _push_waiter_number; /** 等待队列有空位置的线程个数 */
+    uint32_t _spin_number;         /** 进入等待前的自旋次数 */
+    uint32_t _size;                /** 元素个数，供自旋时不加锁地读 */
+
+private:
+    CQueueDelayController* _delay_controller; /** 延迟控制，为NULL表示未开启 */
+    IQueueShedder<DataType>* _shedder;        /** 为NULL表示不丢弃 */
 };
 
 SYS_NAMESPACE_END
@@ -0,0 +1,213 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_FIBER_H
+#define MOOON_SYS_FIBER_H
+#include "mooon/sys/lock.h"
+#include "mooon/sys/spin_lock.h"
+#include "mooon/sys/thread_engine.h"
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 有栈纤程（用户态线程），用于以阻塞的写法调用同步的客户端（如mooon_ssh、r3c_stress等工具），
+  * 成千上万个并发操作只需少量载体线程（carrier，即真正的OS线程）：
+  * 1) 每个纤程有自己的栈，栈底有一个不可访问的警戒页，栈溢出时立即SIGSEGV而不是破坏相邻内存，
+  *    结束的纤程的栈被缓存复用，避免反复mmap和munmap
+  * 2) 每个载体线程有自己的就绪队列，空闲的载体线程从其它载体线程的队列尾部窃取纤程
+  * 3) 纤程中调用sleep、poll、CFiberLock和CFiberEvent时只挂起纤程，载体线程转去运行其它纤程；
+  *    sys::CUtils::millisleep和net::CUtils::timed_poll在纤程中自动调用sleep和poll，
+  *    因此CTcpClient的timed_connect、timed_receive和timed_send在纤程中不会阻塞载体线程，
+  *    但阻塞的connect及阻塞套接字上的full_receive和full_send仍会阻塞载体线程
+  *
+  * 纤程切换基于ucontext（swapcontext），每次切换有一次sigprocmask系统调用。
+  * 纤程中不能使用线程局部的状态跨越挂起点（醒来后可能在另一个载体线程上），
+  * 也不能持有CLock等OS锁挂起。
+  *
+  * 使用示例：
+  * CFiberScheduler scheduler;
+  * scheduler.create(4);
+  * for (int i=0; i<10000; ++i)
+  *     scheduler.spawn(bind(&fetch, i)); // fetch中使用CTcpClient的timed_*接口
+  * scheduler.destroy(); // 等待所有纤程结束
+  */
+class CFiber;
+class CFiberCarrier;
+
+class CFiberScheduler
+{
+    friend class CFiberCarrier;
+    friend class CFiberWaitQueue;
+
+public:
+    CFiberScheduler();
+    ~CFiberScheduler();
+
+    /***
+      * 创建并启动载体线程
+      * @carrier_number: 载体线程个数，为0时取CPU个数
+      * @stack_size: 每个纤程的栈大小（不含警戒页），向上对齐到页大小
+      * @max_cached_stacks: 最多缓存的空闲栈个数
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(uint16_t carrier_number, size_t stack_size=64*1024, uint32_t max_cached_stacks=1024);
+
+    /** 等待所有纤程结束（包括纤程中spawn的纤程），然后停止并销毁所有载体线程 */
+    void destroy();
+
+    /***
+      * 创建一个纤程运行functor，可被任意线程（包括纤程）调用，
+      * 纤程中调用时放入当前载体线程的队列，否则轮流放入各载体线程的队列
+      * @exception: 分配栈出错抛出CSyscallException异常
+      */
+    void spawn(const Functor& functor);
+
+    /** 得到未结束的纤程个数 */
+    uint32_t get_fiber_number() const { return __atomic_load_n(&_fiber_number, __ATOMIC_RELAXED); }
+
+    /** 得到纤程切换次数 */
+    uint64_t get_switch_number() const;
+
+    /** 得到被其它载体线程窃取的纤程个数 */
+    uint64_t get_steal_number() const;
+
+public:
+    /** 判断调用者是否运行在纤程中 */
+    static bool in_fiber();
+
+    /** 让出载体线程，让其它就绪的纤程先运行，不在纤程中时调用sched_yield */
+    static void yield();
+
+    /** 挂起当前纤程milliseconds毫秒，不在纤程中时调用nanosleep */
+    static void sleep(uint32_t milliseconds);
+
+    /***
+      * 等待fd上的事件，语义同net::CUtils::timed_poll（milliseconds为负数表示不超时），不在纤程中时调用poll，
+      * 同一载体线程上同时只能有一个纤程在等待同一个fd
+      * @events: POLLIN、POLLOUT等
+      * @revents: 发生的事件
+      * @return: 超时返回false
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static bool poll(int fd, int events, int milliseconds, int* revents=NULL);
+
+private:
+    CFiber* allocate_fiber();
+    void free_fiber(CFiber* fiber);
+    void schedule(CFiber* fiber);
+    void push(CFiberCarrier* carrier, CFiber* fiber);
+    CFiber* steal(CFiberCarrier* thief);
+    void on_fiber_finished(CFiber* fiber);
+    void wakeup_all();
+
+private:
+    size_t _page_size;
+    size_t _stack_size;
+    uint32_t _max_cached_stacks;
+    uint32_t _cached_stack_number;
+    volatile uint32_t _fiber_number;
+    volatile uint32_t _next_carrier;
+    volatile uint32_t _idle_number;     /** 在epoll_wait中睡眠的载体线程个数 */
+    volatile bool _stop;
+    std::vector<CFiberCarrier*> _carriers;
+    uint64_t _switch_number;            /** 已销毁的载体线程的统计 */
+    uint64_t _steal_number;
+
+private:
+    CLock _free_lock;
+    std::vector<CFiber*> _free_fibers;  /** 空闲的纤程，保留的栈个数不超过_max_cached_stacks */
+    std::vector<CFiber*> _all_fibers;   /** 纤程对象在销毁调度器前不释放，过期的定时器可安全地检查它 */
+};
+
+/***
+  * 纤程的等待队列，CFiberLock和CFiberEvent的内部实现
+  */
+class CFiberWaitQueue
+{
+public:
+    CFiberWaitQueue(): _head(NULL), _tail(NULL) {}
+
+    /***
+      * 将当前纤程放入队列并挂起，直到被wake_one或wake_all唤醒，或超时，
+      * 调用者须已持有_lock，_lock在纤程挂起后才释放，醒来后不再持有
+      * @milliseconds: 为0表示不超时
+      * @return: 超时返回false
+      */
+    bool park(uint32_t milliseconds);
+
+    /***
+      * 唤醒一个纤程，跳过正在超时的，调用者须已持有_lock
+      * @return: 如果唤醒了一个则返回true
+      */
+    bool wake_one();
+    void wake_all();
+
+    /** 从队列中移除，超时的纤程调用，会获取_lock */
+    void remove(CFiber* fiber);
+
+public:
+    CAdaptiveLock _lock;
+
+private:
+    CFiber* _head;
+    CFiber* _tail;
+};
+
+/***
+  * 纤程锁，纤程中得不到锁时挂起纤程而不是阻塞载体线程，
+  * 非纤程线程中也可使用，这时以自旋和sched_yield等待，不支持递归加锁
+  */
+class CFiberLock
+{
+public:
+    CFiberLock(): _locked(0) {}
+
+    void lock();
+    void unlock();
+    bool try_lock();
+
+private:
+    int _locked;
+    CFiberWaitQueue _waiters;
+};
+
+/***
+  * 纤程条件变量，用法同CEvent，但配合CFiberLock使用，
+  * wait和timed_wait只能在纤程中调用，signal和broadcast可被任意线程调用
+  */
+class CFiberEvent
+{
+public:
+    /** 释放lock并挂起，被唤醒后重新获得lock */
+    void wait(CFiberLock& lock);
+
+    /***
+      * 同wait，但最多等待milliseconds毫秒
+      * @return: 如果在超时之前被唤醒，则返回true，否则返回false
+      */
+    bool timed_wait(CFiberLock& lock, uint32_t milliseconds);
+
+    void signal();
+    void broadcast();
+
+private:
+    CFiberWaitQueue _waiters;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_FIBER_H
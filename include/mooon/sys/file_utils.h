@@ -45,18 +45,35 @@ public:
     // false 文件为空文件
     static bool md5sum(std::string* md5_str, const char* filepath);
 
+    // 对一个文件求树形MD5，结果不同于md5sum
+    // 文件被分成chunk_size大小的块，num_threads个线程并行求各块的MD5，
+    // 再对依次拼接的各块MD5（每块16字节）求MD5，作为文件的MD5，
+    // 相同的chunk_size得到相同的结果，与线程数无关
+    //
+    // 返回值：
+    // true 正常得到md5值
+    // false 文件为空文件
+    static bool tree_md5sum(std::string* md5_str, int fd, size_t chunk_size, int num_threads, const char* filepath=NULL);
+    static bool tree_md5sum(std::string* md5_str, const char* filepath, size_t chunk_size=64*1024*1024, int num_threads=4);
+
     // 比较两个文件是否相同
+    // 先比较大小，再以num_threads个线程并行逐块比较内容，遇到不同即停止
     //
     // 返回值：
     // true 两个文件相同或均为空文件
     // false 两个文件不同，或至少有一个文件不存在无法比较
-    static bool compare(int fdA, int fdB);
-    static bool compare(const char* fileA, const char* fileB);
+    static bool compare(int fdA, int fdB, int num_threads=1);
+    static bool compare(const char* fileA, const char* fileB, int num_threads=1);
 
     // 是否存在指定的文件
     static bool exists(const char* filepath);
 
-    /** 文件复制函数
+    /** 文件复制函数，从源文件的当前偏移复制到文件尾，写到目的文件的当前偏移处，
+      * 依次尝试：
+      * 1) reflink（FICLONE），整个文件复制到空文件且文件系统支持（如btrfs、xfs）时，只复制元数据
+      * 2) copy_file_range，在内核中复制，不经过用户空间，部分文件系统还可在服务端或设备内复制
+      * 3) sendfile
+      * 4) 以大块缓冲区read和write，如源或目的不是普通文件
       * @src_fd: 打开的源文件句柄
       * @dst_fd: 打开的目的文件句柄
       * @return: 返回文件大小
@@ -67,6 +84,21 @@ public:
     static size_t file_copy(const char* src_filename, int dst_fd);
     static size_t file_copy(const char* src_filename, const char* dst_filename);
 
+    /** 以num_threads个线程并行复制大文件，每个线程每次以copy_file_range复制chunk_size大小的一块，
+      * 不支持copy_file_range时以pread和pwrite复制，同样先尝试reflink
+      * @dst_filename: 不能已存在，权限模式同源文件
+      * @return: 返回文件大小
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static size_t parallel_file_copy(const char* src_filename, const char* dst_filename, size_t chunk_size=64*1024*1024, int num_threads=4);
+
+    /** 复制文件的同时求MD5，数据只读一次，结果同md5sum
+      * @return: 返回文件大小
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static size_t file_copy_md5sum(int src_fd, int dst_fd, std::string* md5_str);
+    static size_t file_copy_md5sum(const char* src_filename, const char* dst_filename, std::string* md5_str);
+
     /** 得到文件字节数
       * @fd: 文件句柄
       * @return: 返回文件字节数
@@ -83,6 +115,14 @@ public:
       */
     static uint32_t crc32_file(int fd);
     static uint32_t crc32_file(const char* filepath);
+
+    /***
+      * 求得文件的CRC32C（Castagnoli多项式）值，结果不同于crc32_file，
+      * 支持SSE4.2时速度远快于crc32_file，同样会修改读写文件的偏移值
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static uint32_t crc32c_file(int fd);
+    static uint32_t crc32c_file(const char* filepath);
     
     /***
       * 获取文件权限模式
@@ -0,0 +1,187 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_FLIGHT_RECORDER_H
+#define MOOON_SYS_FLIGHT_RECORDER_H
+#include "mooon/sys/config.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+enum
+{
+    FLIGHT_PAYLOAD_MAX = 48,    /** 一个事件的最大负载字节数，超出的被截断 */
+    FLIGHT_EVENT_ID_MAX = 1024  /** 可以命名的事件ID的上限（不含），更大的ID也可以记录，但解码时没有名字 */
+};
+
+/***
+  * 飞行记录器中的一个事件，固定64字节
+  */
+typedef struct TFlightEvent
+{
+    uint64_t timestamp_ns;  /** CClock::get_nanoseconds()的值，和CTracer的时间一致 */
+    uint32_t sequence;      /** 在本线程中的序号加1（取低32位），0表示空槽或正在写 */
+    uint16_t event_id;      /** 由使用者定义，可用CFlightRecorder::name_event命名 */
+    uint16_t payload_size;
+    char payload[FLIGHT_PAYLOAD_MAX];
+}flight_event_t;
+
+/***
+  * 飞行记录器，每个线程一个固定大小的二进制环形缓冲区，保存本线程最近的N个事件（时间戳、事件ID和小的负载），
+  * 用于崩溃或卡住时事后查看现场，日志器来不及flush的上下文也不丢失。
+  *
+  * 记录一个事件为一次读时钟和一次写本线程的缓冲区，不加锁也没有系统调用，写满后覆盖最旧的事件，
+  * 因此可以在生产环境中一直开启高频的记录。线程第一次记录时分配缓冲区，线程退出后缓冲区（连同其中的事件）保留，
+  * 直到被新线程重用。
+  *
+  * 转储只调用write等异步信号安全的函数，可以在致命信号的处理函数中调用（见dump_on_signal），
+  * 转储时仍在写的事件通过sequence识别并在解码时丢弃。转储文件由CFlightReader或工具flight_recorder_decoder解码。
+  *
+  * CMainHelper默认启用，并在致命信号时转储到日志目录下的“程序名.进程号.crash.flight”，
+  * 收到flight_signo信号时转储到“程序名.进程号.时间.flight”，见main_template.h。
+  *
+  * 使用示例：
+  * enum { EVENT_REQUEST_BEGIN = 1, EVENT_REQUEST_END = 2 };
+  * mooon::sys::CFlightRecorder::name_event(EVENT_REQUEST_BEGIN, "request_begin");
+  * MOOON_FLIGHT_RECORD(EVENT_REQUEST_BEGIN, request_id, fd);
+  */
+class CFlightRecorder
+{
+public:
+    /***
+      * 启用或停用记录，默认停用
+      * @events_per_thread: 每个线程保存的事件数，向上取整为2的幂，只影响之后第一次记录的线程
+      */
+    static void enable(bool enabled, uint32_t events_per_thread=1024);
+    static bool is_enabled() { return __atomic_load_n(&_enabled, __ATOMIC_RELAXED); }
+
+    /***
+      * 记录一个事件，未启用时直接返回，通常通过MOOON_FLIGHT_RECORD调用
+      * @payload: 负载，最多FLIGHT_PAYLOAD_MAX字节，超出的被截断
+      */
+    static void record(uint16_t event_id, const void* payload, uint16_t payload_size);
+
+    /** 记录一个以两个整数为负载的事件，解码时显示为两个整数 */
+    static void record(uint16_t event_id, uint64_t value1, uint64_t value2);
+
+    /***
+      * 为事件ID命名，名字写入转储文件，供解码时显示，
+      * @name: 须为字符串常量，ID须小于FLIGHT_EVENT_ID_MAX
+      */
+    static void name_event(uint16_t event_id, const char* name);
+
+    /** 清空所有线程的缓冲区，不能和记录并发 */
+    static void clear();
+
+    /***
+      * 将所有线程的缓冲区写入fd，只调用write，异步信号安全
+      * @signo: 记录在文件头中，0表示按需转储
+      * @return: 写入失败返回false，出错原因可通过errno取得
+      */
+    static bool dump(int fd, int signo=0);
+
+    /***
+      * 转储到文件，文件被截断重写
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static void dump(const std::string& filename);
+
+    /***
+      * 设置dump_on_signal写入的文件，须事先设置，因为信号处理函数中不能格式化文件名
+      */
+    static void set_crash_filename(const std::string& filename);
+
+    /***
+      * 转储到set_crash_filename设置的文件，异步信号安全，
+      * 可作为CSignalHandler::handle_fatal_signals的回调
+      */
+    static void dump_on_signal(int signo);
+
+private:
+    static bool _enabled;
+};
+
+/***
+  * 转储文件中一个线程的事件
+  */
+typedef struct TFlightThread
+{
+    uint32_t thread_id;                 /** 线程的内核ID（gettid） */
+    std::string thread_name;            /** 第一次记录时的线程名（pthread_getname_np） */
+    uint64_t event_number;              /** 线程记录过的事件总数，可能多于缓冲区中保留的 */
+    std::vector<flight_event_t> events; /** 缓冲区中完整的事件，按时间从旧到新 */
+}flight_thread_t;
+
+/***
+  * 飞行记录器转储文件的读取器，用于离线解码
+  */
+class CFlightReader
+{
+public:
+    CFlightReader();
+
+    /***
+      * 读取并解析整个转储文件
+      * @exception: 读文件出错抛出CSyscallException异常，格式不对抛出utils::CException异常
+      */
+    void open(const std::string& filename);
+
+    /** 转储时进程号，以及触发转储的信号（0表示按需转储） */
+    uint32_t get_pid() const { return _pid; }
+    int get_signo() const { return _signo; }
+
+    /** 将事件的时间戳转成“YYYY-MM-DD hh:mm:ss.nnnnnnnnn”的系统时间 */
+    std::string get_datetime(uint64_t timestamp_ns) const;
+
+    /** 得到事件名，没有命名的为“event#ID” */
+    std::string get_event_name(uint16_t event_id) const;
+
+    /***
+      * 将负载格式化成文本，可打印的负载显示为字符串，
+      * 16字节的负载（record两个整数的）显示为两个整数，其它显示为十六进制
+      */
+    static std::string format_payload(const flight_event_t& event);
+
+    const std::vector<flight_thread_t>& get_threads() const { return _threads; }
+
+private:
+    uint32_t _pid;
+    int _signo;
+    uint64_t _monotonic_ns; // 转储时的CClock::get_nanoseconds()
+    uint64_t _realtime_ns;  // 转储时的系统时间
+    std::vector<std::string> _event_names;
+    std::vector<flight_thread_t> _threads;
+};
+
+SYS_NAMESPACE_END
+
+/***
+  * 记录一个事件，负载为最多两个整数，未启用时只有一次判断
+  * MOOON_FLIGHT_RECORD(event_id)
+  * MOOON_FLIGHT_RECORD(event_id, value1)
+  * MOOON_FLIGHT_RECORD(event_id, value1, value2)
+  */
+#define MOOON_FLIGHT_RECORD_2(event_id, value1, value2, ...) \
+    do { \
+        if (::mooon::sys::CFlightRecorder::is_enabled()) \
+            ::mooon::sys::CFlightRecorder::record(event_id, static_cast<uint64_t>(value1), static_cast<uint64_t>(value2)); \
+    } while (false)
+
+#define MOOON_FLIGHT_RECORD(...) MOOON_FLIGHT_RECORD_2(__VA_ARGS__, 0, 0, 0)
+
+#endif // MOOON_SYS_FLIGHT_RECORDER_H
@@ -0,0 +1,149 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_FUTEX_EVENT_H
+#define MOOON_SYS_FUTEX_EVENT_H
+#include "mooon/sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 基于futex的轻量通知事件，接口同CEvent，可直接替换CEvent：
+  * 1) 没有等待者时signal和broadcast只是一次原子操作，不进入内核
+  * 2) 超时为相对时长（CLOCK_MONOTONIC），不受系统时间调整（如NTP）影响
+  * 3) 可以只唤醒n个等待者（wake_n），如一次放入n个元素时
+  * 4) wait和timed_wait可配合任意有lock和unlock的锁，如CLock、CAdaptiveLock和CSpinLock，但非递归锁
+  *
+  * 也可不用锁，以prepare_wait和wait_for组成“事件计数”：
+  * uint32_t epoch = event.prepare_wait();
+  * if (!condition) event.wait_for(epoch, milliseconds); // 检查条件后epoch变了（有唤醒）则立即返回
+  *
+  * 和条件变量一样可能被虚假唤醒，调用者须循环检查条件。
+  */
+class CFutexEvent
+{
+public:
+    CFutexEvent();
+
+    template <class LockClass>
+    void wait(LockClass& lock)
+    {
+        const uint32_t epoch = prepare_wait();
+        lock.unlock();
+        (void)do_wait(epoch, -1);
+        lock.lock();
+    }
+
+    /***
+      * 等待被唤醒或超时，millisecond为0时同wait，和CEvent相同
+      * @return: 被唤醒返回true，超时返回false
+      */
+    template <class LockClass>
+    bool timed_wait(LockClass& lock, uint32_t millisecond)
+    {
+        const uint32_t epoch = prepare_wait();
+        lock.unlock();
+        const bool woken = do_wait(epoch, (0 == millisecond)? -1: static_cast<int>(millisecond));
+        lock.lock();
+        return woken;
+    }
+
+    /***
+      * 登记为等待者并得到当前的序号，之后须调用一次wait_for
+      */
+    uint32_t prepare_wait()
+    {
+        __atomic_add_fetch(&_waiter_number, 1, __ATOMIC_SEQ_CST);
+        return __atomic_load_n(&_epoch, __ATOMIC_SEQ_CST);
+    }
+
+    /***
+      * 序号仍为epoch时等待，为负数的milliseconds表示一直等待
+      * @return: 被唤醒（序号已变）返回true，超时返回false
+      */
+    bool wait_for(uint32_t epoch, int milliseconds)
+    {
+        return do_wait(epoch, milliseconds);
+    }
+
+    /** 不再等待，注销prepare_wait的登记 */
+    void cancel_wait()
+    {
+        __atomic_sub_fetch(&_waiter_number, 1, __ATOMIC_SEQ_CST);
+    }
+
+    /** 唤醒一个等待者 */
+    void signal() { wake_n(1); }
+
+    /** 唤醒所有等待者 */
+    void broadcast() { wake_n(0x7fffffff); }
+
+    /** 唤醒最多n个等待者，没有等待者时不进入内核 */
+    void wake_n(uint32_t n);
+
+    /** 得到等待者的个数（近似值） */
+    uint32_t get_waiter_number() const { return __atomic_load_n(&_waiter_number, __ATOMIC_RELAXED); }
+
+private:
+    CFutexEvent(const CFutexEvent&);
+    CFutexEvent& operator =(const CFutexEvent&);
+    bool do_wait(uint32_t epoch, int milliseconds);
+
+private:
+    uint32_t _epoch;        /** 每次唤醒加一，等待者在其上futex等待 */
+    uint32_t _waiter_number;
+};
+
+/***
+  * 基于futex的进程内计数信号量，超时不受系统时间调整影响，
+  * 没有等待者时post不进入内核，post(n)一次唤醒n个等待者；
+  * 进程间的信号量见CSysVSemaphore
+  */
+class CFutexSemaphore
+{
+public:
+    CFutexSemaphore(uint32_t value=0);
+
+    /** 加value，唤醒最多value个等待者 */
+    void post(uint32_t value=1);
+
+    /** 减一，为0时一直等待 */
+    void wait() { (void)timed_wait(-1); }
+
+    /***
+      * 减一，为0时最多等待milliseconds毫秒，为负数表示一直等待
+      * @return: 成功返回true，超时返回false
+      */
+    bool timed_wait(int milliseconds);
+
+    /** 不等待地减一，为0时返回false */
+    bool try_wait();
+
+    /** 得到当前的值 */
+    uint32_t get_value() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+private:
+    CFutexSemaphore(const CFutexSemaphore&);
+    CFutexSemaphore& operator =(const CFutexSemaphore&);
+
+private:
+    uint32_t _value;
+    CFutexEvent _event;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_FUTEX_EVENT_H
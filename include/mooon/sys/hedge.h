@@ -0,0 +1,305 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_HEDGE_H
+#define MOOON_SYS_HEDGE_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/parallel.h"
+#include "mooon/sys/task_executor.h"
+#include <string>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 对冲请求的策略，见CHedgeController
+  */
+struct CHedgePolicy
+{
+    std::string name;                /** 不为空时记录度量hedge.<name>.sent、won和throttled */
+    uint32_t delay_milliseconds;     /** 固定的对冲延迟，为0表示按观测到的耗时百分位 */
+    double percentile;               /** delay_milliseconds为0时取首个应答耗时的这个百分位 */
+    uint32_t min_delay_milliseconds; /** 按百分位时延迟的下限 */
+    uint32_t max_delay_milliseconds; /** 按百分位时延迟的上限，也是样本不足时的延迟 */
+    uint32_t budget_percent;         /** 对冲数最多为请求数的这个百分比 */
+    uint32_t budget_burst;           /** 最多积攒的对冲次数 */
+
+    CHedgePolicy()
+        : delay_milliseconds(0), percentile(95), min_delay_milliseconds(1), max_delay_milliseconds(1000),
+          budget_percent(10), budget_burst(10)
+    {
+    }
+};
+
+/***
+  * 对冲请求（hedged request）的控制：只读且幂等的请求发出后，
+  * 超过对冲延迟仍没有应答，就向另一个后端再发一份，先到的应答胜出，另一个被取消或丢弃，
+  * 一个慢的副本因此不再决定整体的p99。
+  * 对冲延迟可以固定，也可以取最近观测到的耗时百分位（如p95，即只有最慢的5%会被对冲），
+  * 对冲的次数受预算限制：每个请求积攒budget_percent%次对冲，最多积攒budget_burst次，
+  * 所以即使下游整体变慢，额外的负载也不超过budget_percent%，不会因对冲而放大过载。
+  * 线程安全，供net::CHedgedRedisClient和hedged_call使用，也可用于其它客户端。
+  */
+class CHedgeController
+{
+public:
+    explicit CHedgeController(const CHedgePolicy& policy);
+    ~CHedgeController();
+
+    /***
+      * 一个请求开始，计入对冲预算
+      * @return: 对冲的延迟毫秒数
+      */
+    uint32_t on_request();
+
+    /** 对冲延迟到期仍没有应答时调用，预算足够时扣除并返回true */
+    bool try_hedge();
+
+    /***
+      * 请求得到了应答
+      * @latency_nanoseconds: 从请求开始到首个应答的耗时
+      * @hedge_won: 是否对冲的请求先应答
+      */
+    void on_complete(uint64_t latency_nanoseconds, bool hedge_won);
+
+    /** 得到当前的对冲延迟毫秒数 */
+    uint32_t get_delay_milliseconds() const { return __atomic_load_n(&_delay_milliseconds, __ATOMIC_RELAXED); }
+
+    uint64_t get_hedge_number() const { return __atomic_load_n(&_hedge_number, __ATOMIC_RELAXED); }
+    uint64_t get_won_number() const { return __atomic_load_n(&_won_number, __ATOMIC_RELAXED); }
+    uint64_t get_throttled_number() const { return __atomic_load_n(&_throttled_number, __ATOMIC_RELAXED); }
+
+public:
+    enum
+    {
+        SAMPLE_NUMBER = 512, /** 每积累这么多个样本重新计算一次百分位 */
+        BUDGET_UNIT = 100    /** 预算以百分之一次为单位 */
+    };
+
+private:
+    CHedgeController(const CHedgeController&);
+    CHedgeController& operator =(const CHedgeController&);
+
+private:
+    const CHedgePolicy _policy;
+    CLatencyHistogram _histogram; /** 最近一批样本，重新计算后清空 */
+    CLock _lock;                  /** 保护重新计算 */
+    uint32_t _delay_milliseconds;
+    uint32_t _sample_number;
+    uint64_t _budget;             /** 可用的对冲预算，单位为1/BUDGET_UNIT次 */
+    uint64_t _hedge_number;
+    uint64_t _won_number;
+    uint64_t _throttled_number;
+    CCounter* _sent_counter;
+    CCounter* _won_counter;
+    CCounter* _throttled_counter;
+};
+
+/***
+  * 一次对冲调用的执行者，hedged_call在执行器的线程中调用call，
+  * 首次调用和对冲调用可能同时在执行，为阻塞的客户端（如Thrift和HBase）提供对冲
+  */
+template <typename Result>
+class IHedgedAttempt
+{
+public:
+    virtual ~IHedgedAttempt() {}
+
+    /***
+      * @attempt: 0为首次调用，1为对冲调用，对冲调用应选择和首次不同的后端
+      * @token: 另一次调用已成功时被取消，可在开始前和可中断处检查以尽早放弃
+      * @result: 结果，只有先成功的那次被交给hedged_call的调用者
+      * @return: 成功返回true，失败返回false或抛出异常
+      */
+    virtual bool call(uint32_t attempt, const CCancellationToken& token, Result* result) = 0;
+};
+
+/***
+  * hedged_call的共享状态，内部使用，
+  * 以引用计数释放，因为落败的调用可能在hedged_call返回后才结束
+  */
+template <typename Result>
+class CHedgedState
+{
+public:
+    explicit CHedgedState(IHedgedAttempt<Result>* attempt)
+        : _attempt(attempt), _references(1), _started_number(0), _finished_number(0), _succeeded(false), _winner(0)
+    {
+    }
+
+    ~CHedgedState()
+    {
+        delete _attempt;
+    }
+
+    // 在执行器中开始一次调用，提交失败返回false
+    bool start(CTaskExecutor* executor, uint32_t attempt)
+    {
+        __atomic_add_fetch(&_references, 1, __ATOMIC_SEQ_CST);
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            ++_started_number;
+        }
+        if (executor->submit(utils::bind<void>(&CHedgedState<Result>::run, this, attempt)))
+            return true;
+
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            --_started_number;
+        }
+        release();
+        return false;
+    }
+
+    // 等到有一次成功、全部结束或到达deadline（单调时钟纳秒数，为0表示不限）
+    void wait(uint64_t deadline_nanoseconds)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        while (!_succeeded && (_finished_number < _started_number))
+        {
+            if (0 == deadline_nanoseconds)
+            {
+                _event.wait(_lock);
+            }
+            else
+            {
+                const uint64_t now = CClock::get_nanoseconds();
+                if (now >= deadline_nanoseconds)
+                    break;
+                (void)_event.timed_wait(_lock, static_cast<uint32_t>((deadline_nanoseconds - now + 999999) / 1000000));
+            }
+        }
+    }
+
+    // 是否已结束：有一次成功或全部失败
+    bool is_finished()
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        return _succeeded || (_finished_number == _started_number);
+    }
+
+    // 取走成功的结果
+    bool take_result(Result* result, uint32_t* winner)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        if (!_succeeded)
+            return false;
+        std::swap(*result, _result);
+        *winner = _winner;
+        return true;
+    }
+
+    void release()
+    {
+        if (0 == __atomic_sub_fetch(&_references, 1, __ATOMIC_SEQ_CST))
+            delete this;
+    }
+
+private:
+    void run(uint32_t attempt)
+    {
+        Result result;
+        bool succeeded = false;
+        if (!_token.is_cancelled())
+        {
+            try
+            {
+                succeeded = _attempt->call(attempt, _token, &result);
+            }
+            catch (...)
+            {
+                // 不能让异常进入执行器，否则该次不会被计为结束，调用者会一直等待
+                succeeded = false;
+            }
+        }
+
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            ++_finished_number;
+            if (succeeded && !_succeeded)
+            {
+                _succeeded = true;
+                _winner = attempt;
+                std::swap(_result, result);
+                _token.cancel();
+            }
+            _event.broadcast();
+        }
+        release();
+    }
+
+private:
+    IHedgedAttempt<Result>* _attempt;
+    CCancellationToken _token;
+    uint32_t _references;
+    CLock _lock;
+    CEvent _event;
+    uint32_t _started_number;
+    uint32_t _finished_number;
+    bool _succeeded;
+    uint32_t _winner;
+    Result _result;
+};
+
+/***
+  * 同步的对冲调用：首次调用在执行器中执行，调用者等待对冲延迟，
+  * 仍没有结束且预算足够时在执行器中发起对冲调用，返回先成功的结果；
+  * 首次调用在延迟内失败时不对冲（那是重试，不是对冲）。
+  * 落败的调用不能被中断，只是令牌被取消、结果被丢弃，由执行器的线程继续执行到结束。
+  *
+  * @executor: 执行调用的执行器，至少要有两个线程，否则对冲调用要排在首次调用之后
+  * @attempt: 所有权转移，在两次调用都结束后被删除
+  * @winner: 不为NULL时为胜出的调用，0为首次，1为对冲
+  * @return: 有一次调用成功时返回true
+  *
+  * 使用示例（每次调用从连接池借一个连接，对冲的借另一个后端的）：
+  * class CGetAttempt: public IHedgedAttempt<std::string> { ... };
+  * std::string value;
+  * if (mooon::sys::hedged_call(&executor, &hedge_controller, new CGetAttempt(key), &value))
+  *     ...
+  */
+template <typename Result>
+bool hedged_call(CTaskExecutor* executor, CHedgeController* controller, IHedgedAttempt<Result>* attempt, Result* result, uint32_t* winner=NULL)
+{
+    CHedgedState<Result>* state = new CHedgedState<Result>(attempt);
+    const uint64_t start_nanoseconds = CClock::get_nanoseconds();
+    const uint64_t delay_nanoseconds = static_cast<uint64_t>(controller->on_request()) * 1000000;
+    uint32_t winner_attempt = 0;
+    bool succeeded = false;
+
+    if (state->start(executor, 0))
+    {
+        state->wait(start_nanoseconds + delay_nanoseconds);
+        if (!state->is_finished() && controller->try_hedge())
+            (void)state->start(executor, 1);
+        state->wait(0);
+
+        succeeded = state->take_result(result, &winner_attempt);
+        if (succeeded)
+            controller->on_complete(CClock::get_nanoseconds() - start_nanoseconds, winner_attempt != 0);
+        if (winner != NULL)
+            *winner = winner_attempt;
+    }
+
+    state->release();
+    return succeeded;
+}
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_HEDGE_H
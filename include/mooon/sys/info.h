@@ -18,6 +18,8 @@
  */
 #ifndef MOOON_SYS_INFO_H
 #define MOOON_SYS_INFO_H
+#include <map>
+#include <string>
 #include <vector>
 #include "mooon/sys/config.h"
 SYS_NAMESPACE_BEGIN
@@ -93,6 +95,21 @@ public:
         }
     }process_time_t;
 
+    /***
+      * 线程的CPU时间、上下文切换和调度等待，均为从线程创建起的累计值
+      */
+    typedef struct TThreadTimes
+    {
+        uint64_t user_microseconds;     /** 用户态CPU时间 */
+        uint64_t system_microseconds;   /** 核心态CPU时间 */
+        uint64_t voluntary_switches;    /** 自愿上下文切换次数，如等待锁、IO或sleep */
+        uint64_t involuntary_switches;  /** 非自愿上下文切换次数，即时间片用完或被抢占 */
+        uint64_t run_nanoseconds;       /** 在CPU上运行的纳秒数，取自schedstat，内核不支持时为0 */
+        uint64_t run_delay_nanoseconds; /** 可运行但在运行队列中等待CPU的纳秒数，取自schedstat */
+
+        TThreadTimes();
+    }thread_times_t;
+
     /***
       * 当前系统CPU信息
       */
@@ -364,6 +381,22 @@ public:
 
     /** 获取进程运行时间数据，具体请参考process_time_t的描述 */
     static bool get_process_times(process_time_t& process_time);
+
+    /***
+      * 获取当前线程的时间数据，CPU时间和上下文切换取自getrusage(RUSAGE_THREAD)，精确到微秒，
+      * 运行和调度等待时间取自/proc/thread-self/schedstat
+      */
+    static bool get_current_thread_times(thread_times_t& thread_times);
+
+    /***
+      * 获取本进程内任一线程的时间数据，取自/proc/self/task/<tid>/下的stat、status和schedstat，
+      * CPU时间的精度为时钟滴答（通常为10毫秒）
+      * @tid: 线程的内核ID（gettid），不是pthread_t
+      */
+    static bool get_thread_times(uint32_t tid, thread_times_t& thread_times);
+
+    /** 得到当前线程的内核ID（gettid） */
+    static uint32_t get_current_tid();
         
     /***
       * 获取网卡流量等信息
@@ -378,5 +411,180 @@ private:
     static bool do_get_net_info_array(const char* interface_name, std::vector<net_info_t>& net_info_array);
 };
 
+/***
+  * 保持打开的/proc文件，每次读取以pread从偏移0读入整个文件，
+  * 内容由内核在每次读取时重新生成，省去了每次open和close以及stdio的开销。
+  * 非线程安全
+  */
+class CProcFile
+{
+public:
+    CProcFile();
+    ~CProcFile();
+
+    /** 打开文件，如果已打开则先关闭 */
+    bool open(const char* filename);
+    void close();
+    bool is_open() const { return _fd != -1; }
+
+    /***
+      * 读取整个文件，缓冲区不够时自动扩大
+      * @size: 不为NULL时返回读到的字节数
+      * @return: 以'\0'结尾的文件内容，在下一次读取之前有效，出错返回NULL
+      */
+    const char* read(size_t* size=NULL);
+
+private:
+    CProcFile(const CProcFile&);
+    CProcFile& operator =(const CProcFile&);
+
+private:
+    int _fd;
+    char* _buffer;
+    size_t _buffer_size;
+};
+
+/***
+  * 资源采样器，保持/proc/stat、/proc/self/statm和/proc/net/dev打开，
+  * 每次采样计算与上一次采样之间的增量，得到CPU使用率、上下文切换次数和网卡流量等速率。
+  * 一次采样为几十微秒，每秒采样一次的开销远低于0.1%的CPU。
+  * 非线程安全
+  */
+class CInfoSampler
+{
+public:
+    /***
+      * 网卡每秒的流量
+      */
+    typedef struct TNetRate
+    {
+        char interface_name[INTERFACE_NAME_MAX]; /** 网卡名，如eth0 */
+        double receive_bytes;
+        double receive_packets;
+        double transmit_bytes;
+        double transmit_packets;
+    }net_rate_t;
+
+    /***
+      * 两次采样之间的资源使用速率
+      */
+    typedef struct TResourceRates
+    {
+        uint64_t interval_milliseconds;         /** 与上一次采样的间隔毫秒数 */
+        double cpu_percent;                     /** 系统CPU使用率，为所有CPU的平均，取值0~100 */
+        double cpu_iowait_percent;              /** 系统CPU的IO等待占比 */
+        std::vector<double> cpu_percent_array;  /** 各CPU的使用率，下标为CPU号 */
+        double context_switches;                /** 系统每秒上下文切换次数 */
+        double process_cpu_percent;             /** 当前进程CPU使用率，以一个CPU为100，多线程时可超过100 */
+        double process_context_switches;        /** 当前进程每秒上下文切换次数（包括自愿和非自愿） */
+        uint64_t process_vsize;                 /** 当前进程的虚拟内存字节数（不是速率） */
+        uint64_t process_rss;                   /** 当前进程的物理内存字节数（不是速率） */
+        std::vector<net_rate_t> net_rate_array; /** 各网卡的流量 */
+
+        TResourceRates();
+    }resource_rates_t;
+
+public:
+    CInfoSampler();
+
+    /***
+      * 采样一次
+      * @rates: 存储与上一次采样之间的速率
+      * @return: 第一次采样只建立基线，返回false；出错也返回false
+      */
+    bool sample(resource_rates_t* rates);
+
+    /***
+      * 将速率设置到CMetricsRegistry的度量中，CPU使用率以千分比的整数表示：
+      * system.cpu_permille、system.cpu_iowait_permille、system.context_switches_per_second、
+      * process.cpu_permille、process.context_switches_per_second、process.vsize_bytes、process.rss_bytes、
+      * net.<网卡名>.receive_bytes_per_second等
+      */
+    static void publish_metrics(const resource_rates_t& rates);
+
+private:
+    struct CpuTimes
+    {
+        uint64_t busy;   // 除idle和iowait以外的时间
+        uint64_t iowait;
+        uint64_t total;
+    };
+
+private:
+    bool sample_cpu(double seconds, resource_rates_t* rates);
+    void sample_process(double seconds, resource_rates_t* rates);
+    void sample_net(double seconds, resource_rates_t* rates);
+
+private:
+    CProcFile _stat_file;
+    CProcFile _statm_file;
+    CProcFile _net_dev_file;
+    uint64_t _page_size;
+    uint64_t _last_microseconds;
+    std::vector<CpuTimes> _last_cpu_times; // 下标0为总的，之后依次为各CPU
+    uint64_t _last_context_switches;
+    uint64_t _last_process_cpu_microseconds;
+    uint64_t _last_process_context_switches;
+    std::vector<CInfo::net_info_t> _last_net_info_array;
+};
+
+/***
+  * 线程采样器，对登记了名字的线程，计算两次采样之间的CPU使用率、调度等待占比和上下文切换速率，
+  * 用于区分线程（池）是CPU饱和（CPU使用率接近100，或调度等待占比高），还是在等待（自愿切换多而CPU低）。
+  *
+  * 以set_name设置了名字的CThread和CPoolThread（CThreadPool::set_name）在线程启动时自动登记，退出时注销，
+  * 其它线程可自行调用register_current_thread。
+  * sample非线程安全，通常由一个定时采样的线程调用，之后调用publish_metrics
+  */
+class CThreadSampler
+{
+public:
+    typedef struct TThreadRates
+    {
+        uint32_t tid;                   /** 线程的内核ID */
+        std::string name;               /** 登记的名字 */
+        double cpu_percent;             /** CPU使用率，以一个CPU为100 */
+        double run_delay_percent;       /** 在运行队列中等待CPU的时间占比，内核不支持schedstat时为0 */
+        double voluntary_switches;      /** 每秒自愿上下文切换次数 */
+        double involuntary_switches;    /** 每秒非自愿上下文切换次数 */
+
+        TThreadRates();
+    }thread_rates_t;
+
+public:
+    /***
+      * 登记当前线程，同一线程重复登记时以最后的名字为准，
+      * 同名的多个线程的度量会相互覆盖，因此名字应包含序号，如CThreadPool的<池名>.<序号>
+      */
+    static void register_current_thread(const std::string& name);
+
+    /** 注销当前线程，线程退出前调用 */
+    static void unregister_current_thread();
+
+    /** 得到已登记的线程数 */
+    static size_t get_registered_number();
+
+public:
+    CThreadSampler();
+
+    /***
+      * 对所有登记的线程采样一次
+      * @rates_array: 存储各线程与上一次采样之间的速率，新登记的线程在下一次采样时才有
+      * @return: 第一次采样只建立基线，返回false
+      */
+    bool sample(std::vector<thread_rates_t>* rates_array);
+
+    /***
+      * 将速率设置到CMetricsRegistry的度量中，百分比以千分比的整数表示：
+      * thread.<名字>.cpu_permille、thread.<名字>.run_delay_permille、
+      * thread.<名字>.voluntary_switches_per_second、thread.<名字>.involuntary_switches_per_second
+      */
+    static void publish_metrics(const std::vector<thread_rates_t>& rates_array);
+
+private:
+    uint64_t _last_microseconds;
+    std::map<uint32_t, CInfo::thread_times_t> _last_times; // 键为tid
+};
+
 SYS_NAMESPACE_END
 #endif // MOOON_SYS_INFO_H
@@ -22,6 +22,8 @@
 #include <pthread.h>
 SYS_NAMESPACE_BEGIN
 
+class CLockContention; // 见mooon/sys/profiler.h
+
 /***
   * 互斥锁类
   * 对于非递归锁，同一线程在未释放上一次加的锁之前，
@@ -67,9 +69,20 @@ public:
       */
 	bool timed_lock(uint32_t millisecond);
 
+    /***
+      * 设置锁的名字，命名了的锁在CLockProfiler启用时统计争用（见mooon/sys/profiler.h），
+      * 名字须为字符串常量，同名的锁计入同一个统计，须在锁被使用前调用
+      */
+    void set_contention_name(const char* name) { _contention_name = name; }
+
+private:
+    void profiled_lock();
+
 private:
     pthread_mutex_t _mutex;
     pthread_mutexattr_t _attr;
+    const char* _contention_name;
+    CLockContention* _contention; // 第一次争用时取得
 };
 
 /***
@@ -140,6 +153,11 @@ public:
 	void unlock()
 	{
 	}
+
+	bool try_lock()
+	{
+		return true;
+	}
 };
 
 SYS_NAMESPACE_END
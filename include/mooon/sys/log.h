@@ -19,11 +19,13 @@
 #ifndef MOOON_SYS_LOG_H
 #define MOOON_SYS_LOG_H
 #include <mooon/sys/config.h>
+#include <mooon/sys/spin_lock.h>
 #include <mooon/utils/print_color.h>
 #include <stdio.h>
 SYS_NAMESPACE_BEGIN
 
 class ILogger;
+class CTokenBucket;
 
 /** 不要修改下面的常量值，而应当通过对应的方法去修改
   * 这些常量值主要是方便多模块共享，故放在这个公有头文件当中
@@ -127,6 +129,8 @@ public:
     virtual void enable_auto_adddot(bool enabled) {}
     /** 是否自动添加换行符，如果已经有换行符，则不会再自动添加换行符 */
     virtual void enable_auto_newline(bool enabled) {}   
+    /** 是否折叠连续的相同日志行，折叠的行以“last message repeated N times”汇总，见CLogRepeatFilter */
+    virtual void enable_repeat_filter(bool enabled) {}
     /** 设置日志级别，跟踪日志级别不能通过它来设置 */
     virtual void set_log_level(log_level_t log_level) {}
     /** 设置单个文件的最大建议大小 */
@@ -186,6 +190,79 @@ public:
 
     /** 写二进制日志 */
     virtual void log_bin(const char* filename, int lineno, const char* module_name, const char* log, uint16_t size) {}
+
+    /***
+      * 写结构化日志，应当通过bin_log.h中的MYLOG_STRUCT_*宏来调用
+      * @format_id: 由register_bin_log_format返回的格式ID，参数须和注册的格式串匹配
+      */
+    virtual void vlog_struct(uint32_t format_id, va_list& args) {}
+    virtual void log_struct(uint32_t format_id, ...) {}
+};
+
+/***
+  * 折叠连续的相同日志行，供日志器实现enable_repeat_filter，
+  * 相同是指级别、代码位置和格式化后的内容都相同，不比较时间和线程，比较的是内容的64位哈希值。
+  * 重复的行不输出，直到出现不同的行，或距上一次输出超过LOG_REPEAT_REPORT_SECONDS秒（持续重复时也定期输出），
+  * 这时日志器应先输出一行“last message repeated N times”，再输出当前行。
+  * 线程安全。
+  */
+class CLogRepeatFilter
+{
+public:
+    enum { LOG_REPEAT_REPORT_SECONDS = 10 };
+
+    CLogRepeatFilter();
+
+    void enable(bool enabled) { _enabled = enabled; }
+    bool is_enabled() const { return _enabled; }
+
+    /***
+      * 判断一行日志是否与上一行重复
+      * @content: 格式化后的日志内容，不含时间等日志头
+      * @repeated_number: 不重复时，为上一行之后还未报告的重复行数，为0表示不需要输出汇总行
+      * @repeated_level: repeated_number大于0时，为被重复的行的级别
+      * @return: 重复时返回true，日志器不应输出这一行
+      */
+    bool filter(log_level_t log_level, const char* filename, int lineno, const char* content, size_t content_size,
+                uint32_t* repeated_number, log_level_t* repeated_level);
+
+    /** 取出还未报告的重复行数，如日志器销毁前 */
+    uint32_t take_repeated(log_level_t* repeated_level);
+
+private:
+    bool _enabled;
+    CAdaptiveLock _lock;
+    uint64_t _last_hash;
+    log_level_t _last_level;
+    uint32_t _repeated_number;
+    uint64_t _report_seconds; /** 上一次输出的单调时间秒数 */
+};
+
+/***
+  * 日志调用点的限速状态，由MYLOG_*_RATELIMIT宏定义为调用点的静态变量，
+  * 以令牌桶（CTokenBucket）限制一个调用点每秒输出的行数，被限制的行只计数，
+  * 下一次允许时先输出一行“N similar lines suppressed”，
+  * 这样错误风暴时一个调用点不会塞满日志队列，而日志的开销是有界的。
+  * 线程安全，不加锁。
+  */
+class CLogSiteLimit
+{
+public:
+    /***
+      * @rate: 每秒最多输出的行数，为0时取1
+      * @burst: 最多连续输出的行数，为0时取rate
+      */
+    CLogSiteLimit(uint32_t rate, uint32_t burst=0);
+
+    /***
+      * 是否允许输出
+      * @suppressed_number: 允许时为上一次允许以来被限制的行数
+      */
+    bool allow(uint32_t* suppressed_number);
+
+private:
+    CTokenBucket* _token_bucket; /** 不释放，以便其它全局对象析构时仍可使用 */
+    uint32_t _suppressed_number;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -193,111 +270,101 @@ public:
 extern ILogger* g_logger; // 只是声明，不是定义，不能赋值哦！
 extern bool g_null_print_screen; // 当g_logger为空时是否打屏，默认为false
 
-#define __MYLOG_DETAIL(logger, module_name, format, ...) \
+/***
+  * 全局的日志级别字，日志宏据此判断级别是否打开，不用虚函数调用enabled_*：
+  * 只有g_log_level_logger等于宏使用的日志器（通常为g_logger）时才有效，否则仍调用enabled_*，
+  * 由CLogger和CSafeLogger的set_log_level自动发布，
+  * 直接给g_logger赋值后，应调用publish_log_level(g_logger)，否则日志宏仍走虚函数调用
+  */
+extern ILogger* g_log_level_logger;
+extern int g_log_level;
+
+/***
+  * 如果logger为g_logger，将其级别发布到全局的日志级别字，否则什么也不做，
+  * logger为NULL或get_log_level返回-1（级别未知）时，取消发布
+  */
+extern void publish_log_level(ILogger* logger);
+
+/** 日志器销毁前调用，如果它的级别已发布则取消发布 */
+extern void unpublish_log_level(ILogger* logger);
+
+/***
+  * 日志模块，可按模块设置级别，用于关闭某个模块过多的低级别日志，
+  * 模块只能进一步限制，不能输出日志器未打开的级别的日志。
+  * 模块0为默认模块（不属于任何模块），总是不限制
+  */
+typedef uint16_t log_module_t;
+enum { LOG_MODULE_NUMBER_MAX = 64 };
+extern uint32_t g_log_module_masks[LOG_MODULE_NUMBER_MAX]; /** 每个模块打开的级别的位掩码，第i位对应级别i */
+extern const char* g_log_module_names[LOG_MODULE_NUMBER_MAX];
+
+/***
+  * 注册一个模块，同名的模块只注册一次，默认打开所有级别
+  * @name: 模块名，作为日志行中的模块名，须一直有效（如字符串常量）
+  * @return: 模块号，模块数超过LOG_MODULE_NUMBER_MAX时返回0（默认模块）
+  */
+extern log_module_t register_log_module(const char* name);
+
+/** 设置模块打开的级别的位掩码，如(1<<LOG_LEVEL_WARN)|(1<<LOG_LEVEL_ERROR) */
+extern void set_log_module_mask(log_module_t module, uint32_t mask);
+
+/** 打开模块不低于log_level的级别（含STATE、TRACE等），关闭更低的级别 */
+extern void set_log_module_level(log_module_t module, log_level_t log_level);
+
+/***
+  * 编译期的最低日志级别，低于它的日志语句被完全去掉（参数也不会被求值），
+  * 如以-DMOOON_LOG_MIN_LEVEL=2编译时去掉所有的DETAIL和DEBUG日志，默认为0，即不去掉
+  */
+#ifndef MOOON_LOG_MIN_LEVEL
+#define MOOON_LOG_MIN_LEVEL 0
+#endif
+
+// 级别在编译期是否保留，为常量表达式，不保留时整条语句被编译器去掉
+#define __MYLOG_COMPILED(log_level) (static_cast<int>(log_level) >= MOOON_LOG_MIN_LEVEL)
+
+// 模块是否打开了该级别，默认模块（0）为常量真
+#define __MYLOG_MODULE_ON(module, log_level) \
+    ((0 == (module)) || (0 != ((__atomic_load_n(&::mooon::sys::g_log_module_masks[module], __ATOMIC_RELAXED) >> (log_level)) & 1)))
+
+// 日志器是否打开了该级别，级别已发布时只读全局的级别字（TRACE由开关控制，不按级别）
+#define __MYLOG_LOGGER_ON(logger, log_level, enabled_method) \
+    ((((log_level) <= ::mooon::sys::LOG_LEVEL_STATE) && ((logger) == __atomic_load_n(&::mooon::sys::g_log_level_logger, __ATOMIC_RELAXED))) \
+        ? (static_cast<int>(log_level) >= __atomic_load_n(&::mooon::sys::g_log_level, __ATOMIC_RELAXED)) \
+        : (logger)->enabled_method())
+
+#define __MYLOG_LEVEL(logger, module, module_name, log_level, enabled_method, log_method, screen_prefix, format, ...) \
 do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-	        fprintf(stderr, "[DETAIL][%s:%d]", __FILE__, __LINE__); \
-	        fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_detail()) { \
-		logger->log_detail(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
+    if (!__MYLOG_COMPILED(log_level) || !__MYLOG_MODULE_ON(module, log_level)) { \
+    } \
+    else if (NULL == logger) { \
+        if (::mooon::sys::g_null_print_screen) { \
+            fprintf(stderr, screen_prefix, __FILE__, __LINE__); \
+            fprintf(stderr, format, ##__VA_ARGS__); \
+        } \
+    } \
+    else if (__MYLOG_LOGGER_ON(logger, log_level, enabled_method)) { \
+        logger->log_method(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+    } \
 } while(false)
 
 // C++11要求PRINT_COLOR_NONE前和PRINT_COLOR_DARY_GRAY后保留一个空格，否则编译报警：
 // invalid suffix on literal; C++11 requires a space between literal and identifier [-Wliteral-suffix]
+#define __MYLOG_DETAIL(logger, module_name, format, ...) \
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_DETAIL, enabled_detail, log_detail, "[DETAIL][%s:%d]", format, ##__VA_ARGS__)
 #define __MYLOG_DEBUG(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_DARY_GRAY "[DEBUG][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_debug()) { \
-		logger->log_debug(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
-
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_DEBUG, enabled_debug, log_debug, PRINT_COLOR_DARY_GRAY "[DEBUG][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
 #define __MYLOG_INFO(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, "[INFO][%s:%d]", __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_info()) { \
-		logger->log_info(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
-
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_INFO, enabled_info, log_info, "[INFO][%s:%d]", format, ##__VA_ARGS__)
 #define __MYLOG_WARN(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_YELLOW "[WARN][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_warn()) { \
-		logger->log_warn(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
-
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_WARN, enabled_warn, log_warn, PRINT_COLOR_YELLOW "[WARN][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
 #define __MYLOG_ERROR(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_RED "[ERROR][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_error()) { \
-		logger->log_error(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
-
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_ERROR, enabled_error, log_error, PRINT_COLOR_RED "[ERROR][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
 #define __MYLOG_FATAL(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_BROWN "[FATAL][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_fatal()) { \
-		logger->log_fatal(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
-
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_FATAL, enabled_fatal, log_fatal, PRINT_COLOR_BROWN "[FATAL][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
 #define __MYLOG_STATE(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, "[STATE][%s:%d]", __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_state()) { \
-		logger->log_state(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
-
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_STATE, enabled_state, log_state, "[STATE][%s:%d]", format, ##__VA_ARGS__)
 #define __MYLOG_TRACE(logger, module_name, format, ...) \
-do { \
-	if (NULL == logger) { \
-	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, "[TRACE][%s:%d]", __FILE__, __LINE__); \
-            fprintf(stderr, format, ##__VA_ARGS__); \
-	    } \
-	} \
-	else if (logger->enabled_trace()) { \
-		logger->log_trace(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
-	} \
-} while(false)
+    __MYLOG_LEVEL(logger, 0, module_name, ::mooon::sys::LOG_LEVEL_TRACE, enabled_trace, log_trace, "[TRACE][%s:%d]", format, ##__VA_ARGS__)
 
 #define __MYLOG_RAW(logger, format, ...) \
 do { \
@@ -317,14 +384,31 @@ do { \
         logger->log_bin(__FILE__, __LINE__, module_name, log, size); \
 } while(false)
 
-#define __MYLOG_DETAIL_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_detail())))
-#define __MYLOG_DEBUG_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_debug())))
-#define __MYLOG_INFO_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_info())))
-#define __MYLOG_ERROR_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_error())))
-#define __MYLOG_WARN_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_warn())))
-#define __MYLOG_FATAL_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_fatal())))
-#define __MYLOG_STATE_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_state())))
-#define __MYLOG_TRACE_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_trace())))
+#define __MYLOG_LEVEL_ENABLE(logger, log_level, enabled_method) \
+    (__MYLOG_COMPILED(log_level) && (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && __MYLOG_LOGGER_ON(logger, log_level, enabled_method))))
+#define __MYLOG_DETAIL_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_DETAIL, enabled_detail)
+#define __MYLOG_DEBUG_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_DEBUG, enabled_debug)
+#define __MYLOG_INFO_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_INFO, enabled_info)
+#define __MYLOG_WARN_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_WARN, enabled_warn)
+#define __MYLOG_ERROR_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_ERROR, enabled_error)
+#define __MYLOG_FATAL_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_FATAL, enabled_fatal)
+#define __MYLOG_STATE_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_STATE, enabled_state)
+#define __MYLOG_TRACE_ENABLE(logger) __MYLOG_LEVEL_ENABLE(logger, ::mooon::sys::LOG_LEVEL_TRACE, enabled_trace)
+// 限速的日志宏，每个调用点每秒最多输出rate行，只在级别打开时才消耗令牌，
+// 调用点的状态是静态变量，同一行的宏在所有线程中共享限速
+#define __MYLOG_RATELIMIT(logger, log_level, enabled_method, level_macro, rate, format, ...) \
+do { \
+    if (__MYLOG_LEVEL_ENABLE(logger, log_level, enabled_method)) { \
+        static ::mooon::sys::CLogSiteLimit mylog_site_limit(rate); \
+        uint32_t mylog_suppressed_number; \
+        if (mylog_site_limit.allow(&mylog_suppressed_number)) { \
+            if (mylog_suppressed_number > 0) \
+                level_macro(logger, NULL, "%u similar lines suppressed\n", mylog_suppressed_number); \
+            level_macro(logger, NULL, format, ##__VA_ARGS__); \
+        } \
+    } \
+} while(false)
+
 #define __MYLOG_RAW_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_raw())))
 #define __MYLOG_BIN_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_bin())))
 
@@ -340,6 +424,29 @@ do { \
 #define MYLOG_DEBUG(format, ...)     __MYLOG_DEBUG(::mooon::sys::g_logger, NULL, format, ##__VA_ARGS__)
 #define MYLOG_DETAIL(format, ...)    __MYLOG_DETAIL(::mooon::sys::g_logger, NULL, format, ##__VA_ARGS__)
 
+// 按模块记录日志，module为register_log_module的返回值，如：
+// static const mooon::sys::log_module_t sg_module = mooon::sys::register_log_module("kafka");
+// MYLOG_MODULE_DEBUG(sg_module, "offset: %d\n", offset);
+#define MYLOG_MODULE_DETAIL(module, format, ...) \
+    __MYLOG_LEVEL(::mooon::sys::g_logger, module, ::mooon::sys::g_log_module_names[module], ::mooon::sys::LOG_LEVEL_DETAIL, enabled_detail, log_detail, "[DETAIL][%s:%d]", format, ##__VA_ARGS__)
+#define MYLOG_MODULE_DEBUG(module, format, ...) \
+    __MYLOG_LEVEL(::mooon::sys::g_logger, module, ::mooon::sys::g_log_module_names[module], ::mooon::sys::LOG_LEVEL_DEBUG, enabled_debug, log_debug, PRINT_COLOR_DARY_GRAY "[DEBUG][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
+#define MYLOG_MODULE_INFO(module, format, ...) \
+    __MYLOG_LEVEL(::mooon::sys::g_logger, module, ::mooon::sys::g_log_module_names[module], ::mooon::sys::LOG_LEVEL_INFO, enabled_info, log_info, "[INFO][%s:%d]", format, ##__VA_ARGS__)
+#define MYLOG_MODULE_WARN(module, format, ...) \
+    __MYLOG_LEVEL(::mooon::sys::g_logger, module, ::mooon::sys::g_log_module_names[module], ::mooon::sys::LOG_LEVEL_WARN, enabled_warn, log_warn, PRINT_COLOR_YELLOW "[WARN][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
+#define MYLOG_MODULE_ERROR(module, format, ...) \
+    __MYLOG_LEVEL(::mooon::sys::g_logger, module, ::mooon::sys::g_log_module_names[module], ::mooon::sys::LOG_LEVEL_ERROR, enabled_error, log_error, PRINT_COLOR_RED "[ERROR][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
+#define MYLOG_MODULE_FATAL(module, format, ...) \
+    __MYLOG_LEVEL(::mooon::sys::g_logger, module, ::mooon::sys::g_log_module_names[module], ::mooon::sys::LOG_LEVEL_FATAL, enabled_fatal, log_fatal, PRINT_COLOR_BROWN "[FATAL][%s:%d]" PRINT_COLOR_NONE, format, ##__VA_ARGS__)
+
+// 限速的日志宏，如：MYLOG_ERROR_RATELIMIT(10, "query failed: %s\n", error)
+#define MYLOG_FATAL_RATELIMIT(rate, format, ...) __MYLOG_RATELIMIT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_FATAL, enabled_fatal, __MYLOG_FATAL, rate, format, ##__VA_ARGS__)
+#define MYLOG_ERROR_RATELIMIT(rate, format, ...) __MYLOG_RATELIMIT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_ERROR, enabled_error, __MYLOG_ERROR, rate, format, ##__VA_ARGS__)
+#define MYLOG_WARN_RATELIMIT(rate, format, ...)  __MYLOG_RATELIMIT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_WARN, enabled_warn, __MYLOG_WARN, rate, format, ##__VA_ARGS__)
+#define MYLOG_INFO_RATELIMIT(rate, format, ...)  __MYLOG_RATELIMIT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_INFO, enabled_info, __MYLOG_INFO, rate, format, ##__VA_ARGS__)
+#define MYLOG_DEBUG_RATELIMIT(rate, format, ...) __MYLOG_RATELIMIT(::mooon::sys::g_logger, ::mooon::sys::LOG_LEVEL_DEBUG, enabled_debug, __MYLOG_DEBUG, rate, format, ##__VA_ARGS__)
+
 #define MYLOG_DETAIL_ENABLE() __MYLOG_DETAIL_ENABLE(::mooon::sys::g_logger)
 #define MYLOG_DEBUG_ENABLE() __MYLOG_DEBUG_ENABLE(::mooon::sys::g_logger)
 #define MYLOG_INFO_ENABLE() __MYLOG_INFO_ENABLE(::mooon::sys::g_logger)
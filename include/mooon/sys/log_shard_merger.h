@@ -0,0 +1,95 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_LOG_SHARD_MERGER_H
+#define MOOON_SYS_LOG_SHARD_MERGER_H
+#include "mooon/sys/config.h"
+#include <queue>
+#include <stdio.h>
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 合并CSafeLogger::enable_shard写的分片日志，按时间恢复全局顺序
+  *
+  * 分片文件名为x.log.shard.<pid>.<tid>.<birth>.<segment>，同一个(pid, tid, birth)为一个线程的分片，
+  * 其各段按segment排列。每条记录的格式为“实时纳秒时间 序号 长度 日志行”，日志行为长度个字节。
+  * 同一分片内按写入顺序（即序号）输出，不同分片间按时间归并，时间相同时先输出先打开的分片。
+  * 进程崩溃留下的不完整的最后一条记录被忽略。
+  *
+  * 使用示例：
+  * mooon::sys::CLogShardMerger merger("/data/log", "test.log");
+  * std::string log_line;
+  * while (merger.next(&log_line))
+  *     fwrite(log_line.data(), log_line.size(), 1, stdout);
+  */
+class CLogShardMerger
+{
+public:
+    /***
+      * @log_dir: 日志目录
+      * @log_filename: 日志文件名，如test.log
+      * @exception: 列目录失败时抛出CSyscallException异常
+      */
+    CLogShardMerger(const std::string& log_dir, const std::string& log_filename);
+    ~CLogShardMerger();
+
+    /***
+      * 取下一条日志
+      * @timestamp: 不为NULL时为日志的实时纳秒时间
+      * @return: 已取完时返回false
+      */
+    bool next(std::string* log_line, uint64_t* timestamp=NULL);
+
+    /** 得到分片（线程）数 */
+    size_t get_shard_number() const { return _shards.size(); }
+
+private:
+    struct Shard
+    {
+        std::vector<std::string> segment_paths;
+        size_t segment_index; // 正在读的段
+        FILE* fp;
+        uint64_t timestamp;   // 读到的下一条记录
+        std::string log_line;
+    };
+
+    struct Head
+    {
+        uint64_t timestamp;
+        size_t index;
+
+        bool operator <(const Head& other) const
+        {
+            // priority_queue是大顶堆
+            if (timestamp != other.timestamp)
+                return timestamp > other.timestamp;
+            return index > other.index;
+        }
+    };
+
+    bool read_record(Shard* shard);
+
+private:
+    std::vector<Shard*> _shards;
+    std::priority_queue<Head> _heads;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_LOG_SHARD_MERGER_H
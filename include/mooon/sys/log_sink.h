@@ -0,0 +1,46 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_LOG_SINK_H
+#define MOOON_SYS_LOG_SINK_H
+#include "mooon/sys/config.h"
+#include <sys/uio.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 日志的发送目标，由CLogger::set_sink设置，日志线程将日志成批交给它直接发出（如Kafka或UDP），
+  * 不再先写本地文件再由其它程序读文件转发。
+  * 只在日志线程中被调用，不需要线程安全；发送慢时日志槽被占满，由CLogger的过载策略决定丢弃或阻塞。
+  */
+class ILogSink
+{
+public:
+    virtual ~ILogSink() {}
+
+    /***
+      * 发送一批日志
+      * @log_lines: 日志行，每个一行，含结尾的换行符，调用返回后不再有效
+      * @number: 行数
+      * @return: 从第一行开始成功发送的行数，少于number时剩余的行写入本地日志文件，
+      *          并且在CLogger::set_sink指定的秒数内不再调用，期间的日志都写本地文件
+      */
+    virtual int send(const struct iovec* log_lines, int number) = 0;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_LOG_SINK_H
@@ -29,9 +29,12 @@
 #ifndef MOOON_SYS_LOGGER_H
 #define MOOON_SYS_LOGGER_H
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/bin_log.h>
 #include <mooon/sys/event.h>
+#include <mooon/sys/futex_event.h>
 #include <mooon/sys/lock.h>
 #include <mooon/sys/log.h>
+#include <mooon/sys/log_sink.h>
 #include <mooon/sys/thread.h>
 #include <mooon/utils/array_queue.h>
 #include <sys/epoll.h>
@@ -39,6 +42,7 @@ SYS_NAMESPACE_BEGIN
 
 class CLogger;
 class CLogThread;
+class CTimeThread;
 
 /***
   * 常量定义
@@ -46,11 +50,26 @@ class CLogThread;
 enum
 {
     LOGGER_NUMBER_MAX = 100,     /** 允许创建的最多Logger个数 */
-    LOG_NUMBER_WRITED_ONCE = 10  /** 一次可连接写入的日志条数，最大不能超过IOV_MAX */
+    LOG_NUMBER_WRITED_ONCE = 10, /** 一次可连接写入的日志条数，最大不能超过IOV_MAX */
+    LOG_NUMBER_SENT_ONCE = 64,   /** 设置了ILogSink时一次最多发送的日志条数，最大不能超过IOV_MAX */
+    LOG_SLOT_SIZE_DEFAULT = 512  /** 默认的日志槽大小 */
 };
 
+/***
+  * 日志槽不够用（过载）时的处理策略
+  */
+typedef enum
+{
+    overload_drop_newest = 0, /** 丢弃写不进去的新日志，默认策略 */
+    overload_block       = 1, /** 阻塞写日志的线程，直到有足够的空闲槽 */
+    overload_drop_level  = 2, /** 空闲槽少于1/4时丢弃低于指定级别的日志，没有空闲槽时丢弃新日志 */
+    overload_sample      = 3  /** 空闲槽少于1/4时每N条只保留1条，没有空闲槽时丢弃新日志 */
+}overload_policy_t;
+
 //////////////////////////////////////////////////////////////////////////
 // log_message_t
+// 日志槽的头部，日志内容紧随其后，
+// 一行日志超过一个槽大小时，占用多个连续入队的槽
 typedef struct
 {    
     uint16_t length; // 日志内容长度
@@ -97,18 +116,66 @@ public:
     void destroy();
 
     /** 日志器初始化，非线程安全，只有被一个线程调用一次
+      * 日志槽在这里一次性分配，之后写日志不再有堆内存的分配和释放，
+      * 槽不够用时日志被丢弃并计数，而不是阻塞写日志的线程
       * @log_path: 日志文件存放位置
       * @log_filename: 日志文件名，一包括路径部分
-      * @log_queue_size: 所有日志队列加起来的总大小
-      * @log_queue_number: 日志队列个数
-      * @thread_orderly: 同一个线程的日志是否按时间顺序写
+      * @log_queue_size: 日志槽个数
+      * @log_slot_size: 每个日志槽可存放的日志字节数，长的日志占用多个槽
       * @exception: 如果出错抛出CSyscallException异常
       */
-    void create(const char* log_path, const char* log_filename, uint32_t log_queue_size=1000);
+    void create(const char* log_path, const char* log_filename, uint32_t log_queue_size=1000, uint16_t log_slot_size=LOG_SLOT_SIZE_DEFAULT);
 
     bool is_registered() const { return _registered; }
     void set_registered(bool registered) { _registered = registered; }
 
+    /***
+      * 设置过载策略，默认为overload_drop_newest
+      * @parameter: 对于overload_drop_level为级别阈值（log_level_t），对于overload_sample为N，其它策略忽略
+      */
+    void set_overload_policy(overload_policy_t overload_policy, uint32_t parameter=0);
+
+    /***
+      * 设置在日志中报告丢弃条数的间隔秒数，默认为60，为0表示不报告
+      * 间隔内有日志被丢弃时，以STATE级别写一行各级别的丢弃条数
+      */
+    void set_drop_report_interval(uint32_t seconds) { _drop_report_interval = seconds; }
+
+    /** 得到因日志槽不够而丢弃的日志条数 */
+    uint64_t get_dropped_number() const { return __atomic_load_n(&_dropped_number, __ATOMIC_RELAXED); }
+
+    /** 得到指定级别因过载而丢弃的日志条数 */
+    uint64_t get_dropped_number(log_level_t log_level) const;
+
+    /** 得到因日志槽不够而丢弃的日志字节数 */
+    uint64_t get_dropped_bytes() const { return __atomic_load_n(&_dropped_bytes, __ATOMIC_RELAXED); }
+
+    /***
+      * 日志头中的时间是否带微秒，默认带
+      * 不带微秒时，如果设置了time_thread，则时间取自time_thread，写日志时不再取系统时间
+      */
+    void enable_microseconds(bool enabled) { _microseconds_enabled = enabled; }
+    void set_time_thread(const CTimeThread* time_thread) { _time_thread = time_thread; }
+
+    /***
+      * 是否以结构化二进制格式写日志文件，默认为文本格式，须在create之前调用
+      * 二进制格式下，MYLOG_STRUCT_*宏不再格式化，其它日志在写时格式化后作为文本记录写入，
+      * 日志文件需用tools/bin_log_decoder解码
+      */
+    void enable_binary_format(bool enabled) { _binary_format = enabled; }
+    bool is_binary_format() const { return _binary_format; }
+
+    /***
+      * 设置日志的发送目标，之后日志由日志线程成批直接发给sink，不再写本地文件，
+      * sink发送失败时，未发出的和之后retry_seconds秒内的日志写本地文件，到期后再试sink。
+      * 应在create之后、写日志之前调用，只能设置一次，sink由CLogger负责销毁。
+      * 二进制格式（enable_binary_format）的日志原样交给sink。
+      */
+    void set_sink(ILogSink* sink, uint32_t retry_seconds=5);
+
+    /** 得到空闲的日志槽个数 */
+    uint32_t get_free_slot_number() const { return __atomic_load_n(&_free_slot_number, __ATOMIC_RELAXED); }
+
 public:
     /** 是否允许同时在标准输出上打印日志 */
     virtual void enable_screen(bool enabled);
@@ -120,8 +187,11 @@ public:
     virtual void enable_auto_adddot(bool enabled);
     /** 是否自动添加换行符，如果已经有换行符，则不会再自动添加换行符 */
     virtual void enable_auto_newline(bool enabled);    
+    /** 是否折叠连续的相同日志行，默认不折叠，二进制格式时不折叠 */
+    virtual void enable_repeat_filter(bool enabled);
     /** 设置日志级别，跟踪日志级别不能通过它来设置 */
     virtual void set_log_level(log_level_t log_level);
+    virtual int get_log_level() const;
     /** 设置单个文件的最大建议大小 */
     virtual void set_single_filesize(uint32_t filesize);
     /** 设置备份日志的个数，如果为0，则不备份 */
@@ -149,6 +219,9 @@ public:
 
     virtual void log_bin(const char* filename, int lineno, const char* module_name, const char* log, uint16_t size);
 
+    virtual void vlog_struct(uint32_t format_id, va_list& args);
+    virtual void log_struct(uint32_t format_id, ...);
+
 private: // 日志文件操作
     void close_logfile();
     void create_logfile(bool truncate);
@@ -163,7 +236,15 @@ private:
     bool batch_write();
     bool single_write();
     void do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
+    void queue_log_line(log_level_t log_level, const char* log_line, uint32_t log_line_length);
+    void log_repeated(log_level_t log_level, uint32_t repeated_number);
+    void write_bin_log_formats();
     void push_log_message(log_message_t* log_message);
+    bool push_log_line(log_level_t log_level, const char* log_line, uint32_t log_line_length);
+    bool need_drop(log_level_t log_level, uint32_t slot_number);
+    void report_dropped();
+    void reclaim_slot(log_message_t* log_message);
+    int send_to_sink(const struct iovec* iov_array, int number);
     
 private:    
     int _log_fd;
@@ -173,6 +254,11 @@ private:
     atomic_t _log_level;
     bool _bin_log_enabled;
     bool _trace_log_enabled;
+    bool _microseconds_enabled;
+    const CTimeThread* _time_thread;
+    bool _binary_format;
+    CLogRepeatFilter _repeat_filter;
+    uint32_t _defined_format_number; // 当前日志文件中已写入定义的格式个数
 
 private:        
     bool _registered; // 是否已经被注册到LogThread中
@@ -184,9 +270,34 @@ private:
     char _log_path[PATH_MAX];
     char _log_filename[FILENAME_MAX];
     utils::CArrayQueue<log_message_t*>* _log_queue;
-    volatile int _waiter_number; // 等待PUSH消息的线程个数
-    CEvent _queue_event;
-    CLock _queue_lock; // 保护_log_queue的锁
+    CLock _queue_lock; // 保护_log_queue和日志槽的锁
+
+private: // 预分配的日志槽
+    uint16_t _slot_size;       // 每个槽可存放的日志字节数
+    uint32_t _slot_number;
+    char* _slot_array;
+    uint32_t* _free_slots;     // 空闲槽的下标栈
+    uint32_t _free_slot_number;
+    uint64_t _dropped_number;
+    uint64_t _dropped_bytes;
+
+private: // 过载处理
+    overload_policy_t _overload_policy;
+    uint32_t _overload_parameter;
+    uint32_t _sample_counter;
+    int _waiter_number;        // 等待空闲槽的线程个数
+    CFutexEvent _slot_event;   // 等待者很少，平时broadcast只是一次原子操作
+    uint32_t _drop_report_interval;
+    time_t _last_report_time;
+    bool _has_unreported;       // 上次报告后是否又有丢弃
+    uint64_t _level_dropped_number[LOG_LEVEL_BIN+1];
+    uint64_t _level_reported_number[LOG_LEVEL_BIN+1];
+    log_message_t _destroy_message; // 长度为0，用于通知日志线程销毁Logger
+
+private: // 发送目标，只在日志线程中使用
+    ILogSink* _sink;
+    uint32_t _sink_retry_seconds;
+    time_t _sink_retry_time;    // 发送失败后，到这个时间之前写本地文件
 
 private: // 所有Logger共享同一个CLogThread
     static CLock _thread_lock; // 保护_log_thread的锁
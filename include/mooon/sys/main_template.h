@@ -19,16 +19,34 @@
  * 1) 自动重启进程功能，要求环境变量SELF_RESTART存在，且值为true，其中true不区分大小写
  * 2) 初始化init和反初始化fini函数的自动调用，注意如果初始化init不成功，则不会调用反初始化fini
  * 3) 收到SIGUSR1信号退出进程，退出之前会调用fini
+ * 4) 指定了命令行参数metrics_port或metrics_push时，init成功后启动度量导出器（见net/metrics_exporter.h），
+ *    并按metrics_sample_interval（默认1秒）采样CPU、上下文切换和网卡流量等速率
+ * 5) CMainHelper收到重新加载信号（默认SIGHUP）时在进程内调用on_reload，不重启进程
+ * 6) CMainHelper收到平滑重启信号时启动新进程，以SCM_RIGHTS将登记的监听fd交给新进程，
+ *    新进程初始化成功后旧进程进入排空阶段（on_drain），排空后退出
+ * 7) CMainHelper的use_signal_thread返回false时不创建信号线程，
+ *    由子类把net::CSignalFd加入自己的事件循环，信号在循环线程中处理
+ * 8) CMainHelper启用飞行记录器（见sys/flight_recorder.h），致命信号时转储各线程最近的事件，
+ *    转储后进程仍然coredump，并按1)自动重启
+ * 9) CMainHelper以register_snapshot登记的组件（缓存等）在重启时交给新进程（见sys/snapshot.h）：
+ *    平滑重启时经memfd交给新进程，get_snapshot_filepath不为空时正常退出前保存到文件，启动时采用
+ * 10) CMainHelper在init结束时记录启动各阶段的耗时，子类可在on_init中以CParallelInitializer并行初始化（见sys/startup.h）
  * 注意，只支持下列信号发生时的自动重启:
  * SIGILL，SIGBUS，SIGFPE，SIGSEGV，SIGABRT
  */
 #ifndef MOOON_SYS_MAIN_TEMPLATE_H
 #define MOOON_SYS_MAIN_TEMPLATE_H
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/log.h>
+#include <mooon/sys/signal_handler.h>
+#include <mooon/sys/snapshot.h>
+#include <mooon/sys/startup.h>
 #include <mooon/sys/thread_engine.h>
 #include <mooon/utils/args_parser.h>
+#include <map>
 #include <signal.h>
+#include <vector>
 
 // 指定ReportSelf的配置文件（值为空时表示不上报），
 // 如果report_self_conf指定的文件不存在或配置错误等，将均不能上报
@@ -169,21 +187,98 @@ extern int main_template(IMainHelper* main_helper, int argc, char* argv[], IRepo
 //         _myserver.stop();
 //     }
 //
+//     virtual bool on_reload()
+//     {
+//         // 重新读取配置，缓存和连接保持不变
+//         return _myserver.reload_config();
+//     }
+//
+//     virtual void on_drain()
+//     {
+//         // 新进程已接管监听fd，停止accept，已有的连接继续处理
+//         _myserver.stop_accept();
+//     }
+//
+//     virtual bool is_drained() const
+//     {
+//         return 0 == _myserver.get_connection_number();
+//     }
+//
 // private:
 //     CMyServer _myserver;
 // };
-class CMainHelper: public IMainHelper
+//
+// 不使用信号线程，信号作为事件循环中的普通事件处理（见net/signal_fd.h）：
+// class CMyMainHelper: public mooon::sys::CMainHelper
+// {
+// private:
+//     virtual bool use_signal_thread() const { return false; }
+//
+//     virtual bool on_init(int argc, char* argv[])
+//     {
+//         _reactor_pool.create(4);
+//         mooon::net::CSignalFd* signal_fd = new mooon::net::CSignalFd(this);
+//         signal_fd->create(); // 信号在on_init之前已被阻塞
+//         _reactor_pool.get_loop(0)->post_add(signal_fd, EPOLLIN);
+//         return true;
+//     }
+//
+//     virtual void on_terminated()
+//     {
+//         mooon::sys::CMainHelper::on_terminated();
+//         _myserver.stop(); // 在循环线程中被调用，不用再轮询to_stop
+//     }
+// };
+class CMainHelper: public IMainHelper, public ISignalObserver
 {
 public:
     // log_level_signo
     // 动态调整日志级别的信号，通过该信号可让日志级别在DEBUG和INFO两个级别间互相切换
     // 如果值为0或负值，表示不启用该功能
     //
+    // profile_signo
+    // 启停CPU采样分析的信号（如：kill -s RTMIN+1 进程号），第一次收到时开始采样并启用MOOON_TRACE_SCOPE追踪，
+    // 再次收到时停止，并在日志目录下生成“程序名.进程号.时间.collapsed”（火焰图的折叠栈）和“程序名.进程号.时间.trace.json”，
+    // 采样期间同时分析命名了的锁的争用（见CLockProfiler），停止时生成“程序名.进程号.时间.locks”，
+    // 如果值为0或负值，表示不启用该功能，具体请参考sys/profiler.h
+    //
+    // reload_signo
+    // 重新加载的信号，收到时在信号线程中调用on_reload，如果值为0或负值，表示不启用该功能
+    //
+    // upgrade_signo
+    // 平滑重启的信号，收到时调用graceful_restart，如果值为0或负值（默认），表示不启用该功能
+    //
+    // flight_signo
+    // 转储飞行记录器的信号（如：kill -s RTMIN+2 进程号），收到时在日志目录下生成“程序名.进程号.时间.flight”，
+    // 可用工具flight_recorder_decoder解码，用于进程卡住时查看各线程最近的事件，
+    // 致命信号时总是转储到“程序名.进程号.crash.flight”，如果值为0或负值，表示不启用按信号转储
+    //
     // 注意：对传入的ReportSelf，创建者不需要delete，CMainHelper析构时会对它调用delete
-    CMainHelper(int log_level_signo=SIGUSR2);
+    CMainHelper(int log_level_signo=SIGUSR2, int profile_signo=SIGRTMIN+1, int reload_signo=SIGHUP, int upgrade_signo=0, int flight_signo=SIGRTMIN+2);
     ~CMainHelper();
     void signal_thread();
 
+    // 调用on_reload，与信号触发的重新加载串行，
+    // 可在配置变化的回调中调用（如CConfigCache的IConfigObserver或CZookeeperHelper的on_zookeeper_cache_changed）
+    bool reload();
+
+    // 平滑重启：
+    // 1) 以相同的命令行参数fork并exec新进程（/proc/self/exe）
+    // 2) 通过socketpair以SCM_RIGHTS将register_listen_fd登记的fd交给新进程，
+    //    新进程在on_init中以get_inherited_fd取得，不需要重新bind，已排队的连接也不会丢失
+    // 3) 新进程on_init成功后通知旧进程，旧进程调用on_drain，
+    //    等待is_drained返回true或超过get_drain_milliseconds后，调用on_terminated退出
+    // 新进程在get_handover_milliseconds内未就绪，则被杀死，旧进程继续服务，返回false
+    //
+    // 在信号线程中调用时，排空期间不处理其它信号
+    bool graceful_restart();
+
+    // 分发一个信号，SIGTERM调用on_terminated，SIGCHLD回收子进程后调用on_child_end，
+    // 其它调用on_signal_handler（日志级别切换、采样分析、重新加载和平滑重启），
+    // 用于从其它途径（如自己的signalfd）取得信号的场合，
+    // net::CSignalFd以CMainHelper为观察者时已自动分发，不需要再调用
+    void dispatch_signal(int signo);
+
 private:
     // 子类一般不要重写init，
     // init()过程依次为：
@@ -192,8 +287,8 @@ private:
     // 3) 创建SafeLogger，之后可用MYLOG_xxx记录日志
     // 4) 阻塞信号SIGTERM
     // 5) 调用子类的on_block_signal()
-    // 6) 调用子类的on_init()
-    // 7) 创建信号线程signal_thread
+    // 6) 创建信号线程signal_thread（use_signal_thread返回false时不创建）
+    // 7) 调用子类的on_init()
     //
     // 并捕获了CSyscallException和Exception两个异常
     virtual bool init(int argc, char* argv[]);
@@ -218,6 +313,33 @@ private:
     // 这个时候信号线程已经退出
     virtual void on_fini() {}
 
+    // 重新加载，收到reload_signo信号或调用reload时被调用，
+    // 返回false表示重新加载失败，进程继续用原来的配置运行
+    virtual bool on_reload() { return true; }
+
+    // 平滑重启时新进程已就绪，子类应停止接收新请求（如停止accept），
+    // 之后由is_drained判断已有请求是否处理完
+    virtual void on_drain() {}
+    virtual bool is_drained() const { return true; }
+
+    // 是否创建专门的信号线程，返回false时子类应在on_init中将net::CSignalFd加入事件循环，
+    // 否则收到的信号不会被处理
+    virtual bool use_signal_thread() const { return true; }
+
+    // 排空等待的最长毫秒数
+    virtual uint32_t get_drain_milliseconds() const { return 30000; }
+
+    // 等待新进程就绪的最长毫秒数
+    virtual uint32_t get_handover_milliseconds() const { return 10000; }
+
+    // 飞行记录器每个线程保存的事件数，每个事件64字节，只有记录过事件的线程才分配，
+    // 返回0表示不启用飞行记录器，也不在致命信号时转储
+    virtual uint32_t get_flight_events_per_thread() const { return 1024; }
+
+    // 快照文件，不为空时（且不是平滑重启退出的）正常退出前将register_snapshot登记的组件保存到该文件，
+    // 启动时（不是平滑重启启动的）采用该文件中的快照，采用后文件被删除，返回空（默认）表示不使用文件
+    virtual std::string get_snapshot_filepath() const { return std::string(""); }
+
 public: // 信号相关的
     // 特别注意：
     // 子类可重写on_terminated，
@@ -259,8 +381,53 @@ protected:
     // 返回true表示收到了退出信号，进程应当立即退出
     bool to_stop() const { return _stop; }
 
+    // 登记平滑重启时交给新进程的fd（通常为监听fd），name用于新进程识别，
+    // 从旧进程继承来的fd也需要登记，以便再次平滑重启
+    void register_listen_fd(const std::string& name, int fd);
+
+    // 取得从旧进程继承来的fd，只能在on_init中调用，每个name只能取一次，
+    // 如果不是平滑重启启动的，或旧进程没有登记该name，则返回-1，
+    // on_init之后未被取走的fd被关闭
+    int get_inherited_fd(const std::string& name);
+
+    // 登记重启时保存到快照的组件，只能在on_init中调用，快照中有同名的数据时立即恢复，
+    // 返回true表示从快照恢复了，否则组件冷启动，version为组件数据格式的版本
+    bool register_snapshot(const std::string& name, ISnapshotable* component, uint32_t version=1);
+
+    // 启动各阶段的计时，init结束时记录到日志，依次为parse_arguments、check_parameter、create_logger、
+    // block_signal、handover（取得旧进程交来的fd和快照）和on_init，
+    // 子类可在on_init中以CStartupPhase记录更细的阶段，或传给CParallelInitializer::run：
+    // mooon::sys::CParallelInitializer initializer;
+    // initializer.add_task("db", mooon::utils::bind<bool>(&CMyMainHelper::init_db, this));
+    // initializer.add_task("zookeeper", mooon::utils::bind<bool>(&CMyMainHelper::init_zookeeper, this));
+    // initializer.add_task("cache", mooon::utils::bind<bool>(&CMyMainHelper::load_cache, this), "db");
+    // if (!initializer.run(0, get_startup_profiler()))
+    //     MYLOG_ERROR("%s\n", initializer.get_error().c_str());
+    CStartupProfiler* get_startup_profiler() { return &_startup_profiler; }
+
+private:
+    void toggle_profiler();
+    void init_flight_recorder();
+    void dump_flight_recorder();
+    void receive_inherited_fds();
+    void finish_handover(bool ready);
+    void add_startup_phase(const char* name, uint64_t* start_milliseconds);
+
 private:
     const int _log_level_signo;
+    const int _profile_signo;
+    const int _reload_signo;
+    const int _upgrade_signo;
+    const int _flight_signo;
+    CLock _reload_lock;
+    std::vector<std::string> _argv;              // 平滑重启时以相同的参数启动新进程
+    std::map<std::string, int> _listen_fds;      // 平滑重启时交给新进程的fd
+    std::map<std::string, int> _inherited_fds;   // 从旧进程继承来的fd
+    int _handover_fd;                            // 新进程中与旧进程通信的fd
+    bool _initialized;                           // init是否成功
+    bool _handed_over;                           // 是否已平滑重启交给了新进程
+    CSnapshotManager _snapshot_manager;
+    CStartupProfiler _startup_profiler;
     std::string _log_name;
     std::string _log_suffix;
     uint16_t _logline_size;
@@ -19,8 +19,26 @@
 #ifndef MOOON_SYS_MEM_POOL_H
 #define MOOON_SYS_MEM_POOL_H
 #include "mooon/sys/lock.h"
+#include "mooon/utils/bitmap.h"
+#include <pthread.h>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
+class CMemTracker;
+
+/***
+  * 池内存的来源，用于CRawMemPool::create的backing参数，可按位组合，
+  * 除MEM_POOL_HEAP外都以mmap匿名映射分配，池大到数百MB时可减少TLB缺失和首次访问时的缺页
+  */
+enum
+{
+    MEM_POOL_HEAP     = 0x00, /** 从堆上分配（new） */
+    MEM_POOL_MMAP     = 0x01, /** 以mmap分配普通页 */
+    MEM_POOL_HUGETLB  = 0x02, /** 以MAP_HUGETLB分配大页（需预留/proc/sys/vm/nr_hugepages），不够时退回普通页加MEM_POOL_THP */
+    MEM_POOL_THP      = 0x04, /** 以madvise(MADV_HUGEPAGE)建议使用透明大页 */
+    MEM_POOL_POPULATE = 0x08  /** 创建时预先完成缺页（MAP_POPULATE），避免运行时第一次分配的延迟 */
+};
+
 /***
   * 裸内存池实现，性能高但非线程安全
   */
@@ -40,8 +58,11 @@ public:
       * @use_heap: 内存池不够时，是否从堆上分配
       * @guard_size: 警戒大小
       * @guard_flag: 警戒标识
+      * @numa_node: 池内存优先从该NUMA节点分配，通常为CPoolThread::get_numa_node()，-1表示不指定
+      * @backing: 池内存的来源，为MEM_POOL_HEAP或MEM_POOL_*的组合，mmap失败时退回堆上分配，
+      *           实际使用的可由get_backing得到。无论哪种来源，create时都以guard_flag写满池内存，页都已被访问过
       */
-    void create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m') throw ();
+    void create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m', int numa_node=-1, uint32_t backing=MEM_POOL_HEAP) throw ();
 
     /***
       * 分配内存内存
@@ -74,6 +95,18 @@ public:
     /** 得到内存池中，当前还可以分配的内存个数 */
     uint32_t get_available_number() const throw ();
 
+    /** 得到池内存实际的来源，如请求MEM_POOL_HUGETLB但大页不够时，返回MEM_POOL_MMAP|MEM_POOL_THP */
+    uint32_t get_backing() const throw ();
+
+    /***
+      * 设置内存统计，之后分配出去（含池不够时从堆上分配）的内存计入tracker，回收时减去，
+      * destroy时池中未回收的被减去，为NULL表示不统计（默认）
+      */
+    void set_mem_tracker(CMemTracker* mem_tracker) throw () { _mem_tracker = mem_tracker; }
+
+private:
+    char* map_memory(size_t size, int numa_node, uint32_t backing) throw ();
+
 private:    
     bool _use_heap;             /** 内存池不够时，是否从堆上分配 */
     uint8_t _guard_size;        /** 警戒大小，实际需要的内存大小为: (_guard_size+_bucket_size)*_bucket_number */
@@ -81,21 +114,41 @@ private:
     uint32_t _bucket_number;    /** 内存个数 */
     volatile uint32_t _stack_top_index;  /** 栈顶索引 */
     volatile uint32_t _available_number; /** 池中还可以分配的内存个数 */
+    uint32_t _backing;          /** 池内存实际的来源 */
+    size_t _mapped_size;        /** mmap的大小，为0表示池内存从堆上分配 */
+    CMemTracker* _mem_tracker;  /** 分配出去的内存计入的统计 */
 
 private:
     char* _stack_top;    
     char* _stack_bottom;
     char** _bucket_stack;
-    char* _bucket_bitmap; /** 桶状态，用来记录当前状态，以防止重复回收 */
+    utils::CBitmap _bucket_bitmap; /** 桶是否已分配，以防止重复回收 */
 };
 
+/***
+  * 线程缓存的统计
+  */
+typedef struct
+{
+    uint64_t hit_number;    /** 直接从线程缓存中分配或回收到线程缓存中的次数 */
+    uint64_t miss_number;   /** 需要加锁访问共享池的次数 */
+    uint32_t cached_number; /** 线程缓存中当前的内存个数 */
+}thread_cache_stat_t;
+
 /***
   * 线程安全的内存池，性能较CRawMemPool要低
+  *
+  * 可调用enable_thread_cache启用线程缓存：每个线程有一个私有的弹匣（magazine），
+  * allocate和reclaim优先操作弹匣，只在弹匣为空或满时才加锁，
+  * 并以半个弹匣为单位批量从共享池取或还给共享池。
+  * 启用线程缓存后，在弹匣中的内存对共享池而言仍是已分配的，
+  * 因此get_available_number不包含它们，重复回收检测也只在归还共享池时才进行。
   */
 class CThreadMemPool
 {
 public:
-    CThreadMemPool() {}
+    CThreadMemPool();
+    ~CThreadMemPool();
 
     /** 销毁由create创建的内存池 */
     void destroy();
@@ -107,8 +160,9 @@ public:
       * @use_heap: 内存池不够时，是否从堆上分配
       * @guard_size: 警戒大小
       * @guard_flag: 警戒标识
+      * @backing: 池内存的来源，同CRawMemPool::create
       */
-    void create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m');
+    void create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m', uint32_t backing=MEM_POOL_HEAP);
 
     /***
       * 分配内存内存
@@ -140,10 +194,47 @@ public:
 
     /** 得到内存池中，当前还可以分配的内存个数 */
     uint32_t get_available_number() const throw ();
-    
+
+    /** 同CRawMemPool::set_mem_tracker，启用线程缓存时弹匣中的也计入 */
+    void set_mem_tracker(CMemTracker* mem_tracker);
+
+    /***
+      * 启用线程缓存，应当在create之后、被多线程使用之前调用
+      * @magazine_size: 每个线程的弹匣可容纳的内存个数，为0表示不启用
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    void enable_thread_cache(uint32_t magazine_size);
+
+    /** 得到调用线程的线程缓存统计 */
+    thread_cache_stat_t get_thread_cache_stat() const;
+
+    /** 得到所有线程缓存的统计之和 */
+    thread_cache_stat_t get_total_cache_stat() const;
+
+private:
+    struct Magazine
+    {
+        CThreadMemPool* pool;
+        uint32_t number;
+        uint64_t hit_number;
+        uint64_t miss_number;
+        void** buckets;
+    };
+
+    static void on_thread_exit(void* magazine);
+    Magazine* get_magazine();
+    void flush_magazine(Magazine* magazine, uint32_t number);
+    void release_magazines();
+
 private:
-    CLock _lock;
+    mutable CLock _lock;
     CRawMemPool _raw_mem_pool;
+
+private:
+    uint32_t _magazine_size;
+    bool _key_created;
+    pthread_key_t _magazine_key;
+    std::vector<Magazine*> _magazines;
 };
 
 SYS_NAMESPACE_END
@@ -0,0 +1,92 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_MEM_TRACKER_H
+#define MOOON_SYS_MEM_TRACKER_H
+#include "mooon/sys/config.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+class CGauge;
+
+/***
+  * 按标签统计内存，用于找出是哪个模块的内存在增长（get_self_memory只能得到整个进程的RSS和VSZ）：
+  * 每个标签对应度量注册表中的两个当前值，mem.<标签>.bytes为当前占用的字节数，mem.<标签>.peak为其峰值，
+  * 记一次分配或释放只是一两次原子操作，不加锁。
+  *
+  * 库内已统计的标签（须调用者设置的除外，总是统计）：
+  * 1) CRawMemPool、CThreadMemPool和CRawObjectPool：set_mem_tracker设置的标签，统计已分配（借出）的
+  * 2) logger：CLogger队列中还未写的日志槽
+  * 3) io_buffer：CIoBuffer从堆上分配的块（从块池分配的由池的标签统计）
+  * 4) db_result：CDBQueryCache缓存或被持有的查询结果，按字段值的长度估算
+  *
+  * 使用示例：
+  * static mooon::sys::CMemTracker* tracker = mooon::sys::CMemTracker::get_tracker("session");
+  * tracker->allocate(sizeof(Session));
+  * tracker->release(sizeof(Session));
+  */
+class CMemTracker
+{
+public:
+    /***
+      * 得到标签的统计，第一次时创建，同一标签总是返回同一个对象，
+      * 对象不会被释放，应取得一次后保存指针
+      */
+    static CMemTracker* get_tracker(const std::string& tag);
+
+    /** 得到所有的统计，按标签排序 */
+    static void get_trackers(std::vector<CMemTracker*>* trackers);
+
+    /** 所有标签当前占用的字节数之和 */
+    static int64_t get_tracked_bytes();
+
+    /***
+      * 启用malloc的采样：每次取度量快照时（如CMetricsRegistry::start的快照线程），
+      * 以mallinfo2更新mem.malloc.bytes（malloc出去且未free的字节数）、mem.malloc.mmap_bytes（其中以mmap分配的），
+      * 以及mem.untracked.bytes（mem.malloc.bytes减去所有标签之和），
+      * 后者持续增长说明有标签之外的泄漏或膨胀。
+      * glibc早于2.33时没有mallinfo2，这三个值都为0
+      */
+    static void enable_malloc_sampling();
+
+    /** 立即采样一次malloc，同enable_malloc_sampling，返回是否支持 */
+    static bool sample_malloc();
+
+public:
+    void allocate(size_t size);
+    void release(size_t size);
+
+    const std::string& get_tag() const { return _tag; }
+    int64_t get_bytes() const;
+    int64_t get_peak() const;
+
+private:
+    CMemTracker(const std::string& tag);
+    CMemTracker(const CMemTracker&);
+    CMemTracker& operator =(const CMemTracker&);
+    static void collect(void* context);
+
+private:
+    const std::string _tag;
+    CGauge* _bytes;
+    CGauge* _peak;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_MEM_TRACKER_H
@@ -0,0 +1,306 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_METRICS_H
+#define MOOON_SYS_METRICS_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/string_interner.h"
+#include "mooon/utils/json_writer.h"
+#include <map>
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+class CThreadEngine;
+
+/***
+  * 计数器，只增不减
+  * 计数分散在多个独占缓存行的分片中，每个线程固定使用其中一个分片（同CDistributedReadWriteLock），
+  * 增加计数只是对本线程分片的一次原子加，各CPU之间没有缓存行争用，读取时累加所有分片
+  */
+class CCounter
+{
+public:
+    CCounter();
+    ~CCounter();
+
+    void inc(uint64_t number=1);
+    uint64_t get() const;
+    void reset();
+
+private:
+    struct Shard
+    {
+        uint64_t value;
+        char pad[CACHE_LINE_SIZE - sizeof(uint64_t)]; // 每个分片独占一个缓存行
+    };
+
+private:
+    Shard* _shards;
+    uint32_t _shard_mask;
+};
+
+/***
+  * 当前值，如队列长度、连接数等，通常只有一个写者，不分片
+  */
+class CGauge
+{
+public:
+    CGauge(): _value(0) {}
+
+    void set(int64_t value) { __atomic_store_n(&_value, value, __ATOMIC_RELAXED); }
+    int64_t add(int64_t value) { return __atomic_add_fetch(&_value, value, __ATOMIC_RELAXED); }
+    int64_t get() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+    /** 大于当前值时才更新，用于记录峰值 */
+    void update_max(int64_t value)
+    {
+        int64_t current = get();
+        while ((value > current)
+           && !__atomic_compare_exchange_n(&_value, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+
+private:
+    int64_t _value;
+};
+
+/***
+  * 直方图的快照，可合并（如合并多个进程或多个时间段的），
+  * 合并后的百分位数与所有值记录在同一个直方图中的完全相同
+  */
+class CHistogramSnapshot
+{
+public:
+    CHistogramSnapshot();
+
+    void clear();
+    void merge(const CHistogramSnapshot& other);
+
+    uint64_t get_count() const { return _count; }
+    uint64_t get_sum() const { return _sum; }
+    uint64_t get_min() const { return (0 == _count)? 0: _min; }
+    uint64_t get_max() const { return _max; }
+    uint64_t get_mean() const { return (0 == _count)? 0: _sum / _count; }
+
+    /***
+      * 得到百分位数，返回值所在桶的上界（不超过最大值），相对误差不超过1/32
+      * @percentile: 取值[0, 100]，如50、99、99.9
+      * @return: 没有值时返回0
+      */
+    uint64_t get_percentile(double percentile) const;
+
+private:
+    friend class CLatencyHistogram;
+    std::vector<uint64_t> _buckets;
+    uint64_t _count;
+    uint64_t _sum;
+    uint64_t _min;
+    uint64_t _max;
+};
+
+/***
+  * 对数线性（HDR）直方图，用于统计延迟分布，值的单位由使用者决定，通常为纳秒
+  * 每个2的幂区间再线性分成32个桶，小于32的值各占一个桶，
+  * 支持的最大值为2^44-1（以纳秒计约4.9小时），更大的值计入最后一个桶。
+  *
+  * 同CCounter分片，记录一个值为本线程分片上的几次原子操作，不加锁
+  */
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram();
+    ~CLatencyHistogram();
+
+    void record(uint64_t value);
+
+    /***
+      * 取快照，合并所有分片
+      * @reset: 是否同时清零，用于得到每个时间段的分布，
+      *         与正在进行的record并发时，个别值可能计入下一个时间段
+      */
+    void get_snapshot(CHistogramSnapshot* snapshot, bool reset=false);
+
+    static uint32_t get_bucket_index(uint64_t value);
+    static uint64_t get_bucket_upper_bound(uint32_t index);
+
+private:
+    struct Shard
+    {
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+        char pad[CACHE_LINE_SIZE - sizeof(uint64_t)*3];
+        uint64_t buckets[1]; // 实际大小为桶数
+    };
+
+private:
+    Shard** _shards;
+    uint32_t _shard_mask;
+};
+
+/***
+  * 记录从构造到析构所经过的纳秒数
+  */
+class CLatencyRecorder
+{
+public:
+    CLatencyRecorder(CLatencyHistogram* histogram)
+        : _histogram(histogram), _start_nanoseconds(CClock::get_nanoseconds())
+    {
+    }
+
+    ~CLatencyRecorder()
+    {
+        _histogram->record(CClock::get_nanoseconds() - _start_nanoseconds);
+    }
+
+private:
+    CLatencyHistogram* _histogram;
+    uint64_t _start_nanoseconds;
+};
+
+// 所有度量的快照
+struct MetricsSnapshot
+{
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, int64_t> gauges;
+    std::map<std::string, CHistogramSnapshot> histograms;
+};
+
+// 定时快照的回调，在快照线程中被调用
+typedef void (*metrics_reporter_t)(const MetricsSnapshot& snapshot, void* context);
+
+// 采集回调，在每次取快照之前被调用，用于更新需要主动采样的度量（如malloc的统计）
+typedef void (*metrics_collector_t)(void* context);
+
+/***
+  * 度量注册表，按名字管理所有的计数器、当前值和直方图，
+  * 同名的度量只有一个，多个对象（如多个Logger）使用同一名字时计入同一个度量。
+  *
+  * 只有创建和快照时加锁，度量创建后一直存在（不会被释放），
+  * 因此使用者应在第一次使用时取得并保存指针，之后的更新不经过注册表。
+  *
+  * 库内已注册的度量：
+  * logger.lines、logger.dropped、logger.write_ns、logger.backlog、logger.sink_sent、logger.sink_fallback
+  * reactor.events、reactor.dispatch_ns、reactor.pending_tasks、reactor.expired_tasks、reactor.budget_exhausted
+  * reactor.loop<编号>.iteration_ns、events_per_wait、busy_ns、wait_ns、timer_lag_ms、pending_tasks、slow_handlers，见CEventLoop
+  * http.requests、http.bad_requests、http.not_found、http.connections、http.route.<路径>.requests和latency_ns
+  * event_queue.pop_timeout、event_queue.push_timeout
+  * db_pool.borrow_wait_ns、db_pool.borrow_timeout
+  * kafka.delivered、kafka.delivery_error、kafka.delivery_latency_ns、kafka.spooled、kafka.replayed
+  * thrift_pool.borrow_failure、thrift_pool.hold_ns
+  * rate_limiter.<名字>.allowed、rate_limiter.<名字>.throttled
+  * prefork.<名字>、prefork.worker<序号>.<名字>、prefork.restarts、prefork.workers
+  * mysql_async.latency_ns、mysql_async.errors
+  * cache.<名字>.hits、misses、evictions、expirations、rejections、loads、shared_loads
+  * mem.<标签>.bytes、mem.<标签>.peak，见CMemTracker，以及mem.malloc.bytes、mem.malloc.mmap_bytes、mem.untracked.bytes
+  * queue.<名字>.sojourn_ns、queue.<名字>.shed，见CQueueDelayController
+  * thread_pool.<名字>.threads、scale_up、scale_down、wait_ns，见CThreadPool::create_elastic
+  * object_pool.<名字>.objects、borrowed、high_water_mark、heap、grow、shrink、heap_allocations，见CRawObjectPool::create_elastic
+  * send_queue.bytes、send_queue.paused、send_queue.over_budget，见CSendBudget
+  * recv_buffer.bytes，见CRecvBuffer
+  * lock.<名字>.wait_ns、lock.<名字>.contended，见CLockProfiler
+  * thread.<线程名>.cpu_permille、run_delay_permille、voluntary_switches_per_second、involuntary_switches_per_second，见CThreadSampler
+  */
+class CMetricsRegistry
+{
+public:
+    static CMetricsRegistry* get_singleton();
+
+    CCounter* get_counter(const std::string& name);
+    CGauge* get_gauge(const std::string& name);
+    CLatencyHistogram* get_histogram(const std::string& name);
+
+    /***
+      * 同上，但以驻留的名字查找：只比较指针，没有字符串的复制和比较，
+      * 适合不便保存度量指针、每次都要查找的调用点（如按路由名或表名动态取度量）
+      */
+    CCounter* get_counter(const CInternedString& name);
+    CGauge* get_gauge(const CInternedString& name);
+    CLatencyHistogram* get_histogram(const CInternedString& name);
+
+    /***
+      * 添加采集回调，不能删除，同一回调和context只添加一次，
+      * 回调中可以调用get_counter等，但不能调用get_snapshot
+      */
+    void add_collector(metrics_collector_t collector, void* context=NULL);
+
+    /***
+      * 取所有度量的快照
+      * @reset_histograms: 是否同时清零直方图，计数器总是累计值
+      */
+    void get_snapshot(MetricsSnapshot* snapshot, bool reset_histograms=false);
+
+    /***
+      * 启动快照线程，每interval_seconds秒取一次快照（清零直方图，即百分位数为每个周期的），
+      * 如果reporter为NULL，则以MYLOG_INFO输出
+      * @exception: 创建线程出错抛出CSyscallException异常
+      */
+    void start(uint32_t interval_seconds, metrics_reporter_t reporter=NULL, void* context=NULL);
+    void stop();
+
+    /** 得到快照线程最近一次取得的快照 */
+    void get_last_snapshot(MetricsSnapshot* snapshot) const;
+
+    /***
+      * 转成文本，每个度量一行，直方图输出count、mean、p50、p99、p999和max
+      */
+    static std::string to_string(const MetricsSnapshot& snapshot);
+
+    /***
+      * 转成Prometheus文本格式（0.0.4），名字中的非法字符替换为下划线，
+      * 直方图输出为summary，即quantile为0.5、0.99和0.999，以及_sum和_count
+      */
+    static std::string to_prometheus(const MetricsSnapshot& snapshot);
+
+    /***
+      * 转成JSON格式：{"counters":{...},"gauges":{...},"histograms":{"name":{"count":...}}}
+      */
+    static std::string to_json(const MetricsSnapshot& snapshot);
+
+    /** 同上，以writer输出，可直接写入链式缓冲区等 */
+    static void to_json(const MetricsSnapshot& snapshot, utils::CJsonWriter* writer);
+
+private:
+    CMetricsRegistry();
+    void run();
+
+private:
+    mutable CLock _lock;
+    std::map<std::string, CCounter*> _counters;
+    std::map<std::string, CGauge*> _gauges;
+    std::map<std::string, CLatencyHistogram*> _histograms;
+    utils::CFlatHashMap<CInternedString, CCounter*> _interned_counters;
+    utils::CFlatHashMap<CInternedString, CGauge*> _interned_gauges;
+    utils::CFlatHashMap<CInternedString, CLatencyHistogram*> _interned_histograms;
+    std::vector<std::pair<metrics_collector_t, void*> > _collectors;
+
+private:
+    CLock _thread_lock;
+    CEvent _thread_event;
+    CThreadEngine* _engine;
+    volatile bool _stop;
+    uint32_t _interval_seconds;
+    metrics_reporter_t _reporter;
+    void* _context;
+    MetricsSnapshot _last_snapshot;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_METRICS_H
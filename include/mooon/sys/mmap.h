@@ -37,54 +37,60 @@ public:
       * @size: 需要映射到内存的大小，如果为0则映射整个文件
       * @offset: 映射的偏移位置
       * @size_max: 最大可映射字节数，超过此大小的文件将不会被映射到内存，mmap_t结构的addr成员将为NULL
+      * @map_flags: 和MAP_SHARED一起传给mmap的标志，如MAP_POPULATE表示映射时即预读入所有页，之后访问不再缺页
       * @return: 返回指向mmap_t结构的指针，返回值总是不会为NULL
       * @exception: 出错抛出CSyscallException异常
       */
-    static mmap_t* map_read(int fd, size_t size=0, size_t offset=0, size_t size_max=0);
+    static mmap_t* map_read(int fd, size_t size=0, size_t offset=0, size_t size_max=0, int map_flags=0);
 
     /** 以只读方式将文件映射到内存
       * @filename: 文件名，mmap_t结构的fd成员为打开此文件的句柄
       * @size_max: 最大可映射字节数，超过此大小的文件将不会被映射到内存，mmap_t结构的addr成员将为NULL
+      * @map_flags: 和MAP_SHARED一起传给mmap的标志，如MAP_POPULATE表示映射时即预读入所有页，之后访问不再缺页
       * @return: 返回指向mmap_t结构的指针，返回值总是不会为NULL
       * @exception: 出错抛出CSyscallException异常
       */
-    static mmap_t* map_read(const char* filename, size_t size_max=0);
+    static mmap_t* map_read(const char* filename, size_t size_max=0, int map_flags=0);
 
     /** 以只写方式将文件映射到内存
       * @fd: 文件句柄，调用者需要负责关闭此句柄，mmap_t结构的fd成员为它的负值
       * @size: 需要映射到内存的大小，如果为0则映射整个文件
       * @offset: 映射的偏移位置
       * @size_max: 最大可映射字节数，超过此大小的文件将不会被映射到内存，mmap_t结构的addr成员将为NULL
+      * @map_flags: 和MAP_SHARED一起传给mmap的标志，如MAP_POPULATE表示映射时即预读入所有页，之后访问不再缺页
       * @return: 返回指向mmap_t结构的指针，返回值总是不会为NULL
       * @exception: 出错抛出CSyscallException异常
       */
-    static mmap_t* map_write(int fd, size_t size=0, size_t offset=0, size_t size_max=0);
+    static mmap_t* map_write(int fd, size_t size=0, size_t offset=0, size_t size_max=0, int map_flags=0);
 
     /** 以只写方式将文件映射到内存
       * @filename: 文件名，mmap_t结构的fd成员为打开此文件的句柄
       * @size_max: 最大可映射字节数，超过此大小的文件将不会被映射到内存，mmap_t结构的addr成员将为NULL
+      * @map_flags: 和MAP_SHARED一起传给mmap的标志，如MAP_POPULATE表示映射时即预读入所有页，之后访问不再缺页
       * @return: 返回指向mmap_t结构的指针，返回值总是不会为NULL
       * @exception: 出错抛出CSyscallException异常
       */
-    static mmap_t* map_write(const char* filename, size_t size_max=0);
+    static mmap_t* map_write(const char* filename, size_t size_max=0, int map_flags=0);
 
     /** 以读和写方式将文件映射到内存
       * @fd: 文件句柄，调用者需要负责关闭此句柄，mmap_t结构的fd成员为它的负值
       * @size: 需要映射到内存的大小，如果为0则映射整个文件
       * @offset: 映射的偏移位置
       * @size_max: 最大可映射字节数，超过此大小的文件将不会被映射到内存，mmap_t结构的addr成员将为NULL
+      * @map_flags: 和MAP_SHARED一起传给mmap的标志，如MAP_POPULATE表示映射时即预读入所有页，之后访问不再缺页
       * @return: 返回指向mmap_t结构的指针，返回值总是不会为NULL
       * @exception: 出错抛出CSyscallException异常
       */
-    static mmap_t* map_both(int fd, size_t size=0, size_t offset=0, size_t size_max=0);
+    static mmap_t* map_both(int fd, size_t size=0, size_t offset=0, size_t size_max=0, int map_flags=0);
 
     /** 以读和写方式将文件映射到内存
       * @filename: 文件名，mmap_t结构的fd成员为打开此文件的句柄
       * @size_max: 最大可映射字节数，超过此大小的文件将不会被映射到内存，mmap_t结构的addr成员将为NULL
+      * @map_flags: 和MAP_SHARED一起传给mmap的标志，如MAP_POPULATE表示映射时即预读入所有页，之后访问不再缺页
       * @return: 返回指向mmap_t结构的指针，返回值总是不会为NULL
       * @exception: 出错抛出CSyscallException异常
       */
-    static mmap_t* map_both(const char* filename, size_t size_max=0);
+    static mmap_t* map_both(const char* filename, size_t size_max=0, int map_flags=0);
 
     /***
       * 释放已创建的内存映射，如果是通过指定文件名映射的，则关闭在mmap中打开的句柄
@@ -115,8 +121,20 @@ public:
       */
     static void async_flush(mmap_t* ptr, size_t offset=0, size_t length=0, bool invalid=false);
 
+    /***
+      * 告知内核映射区的访问方式，即madvise
+      * @ptr: 指向map_read、map_both或map_write得到的mmap_t指针
+      * @advice: 如MADV_SEQUENTIAL（顺序访问，加大预读并尽早回收已读过的页）、
+      *          MADV_WILLNEED（即将访问，异步预读）、MADV_DONTNEED（不再访问）、
+      *          MADV_HUGEPAGE（使用透明大页，文件映射需内核支持文件的透明大页）
+      * @offset: 偏移位置，会向下对齐到页
+      * @length: 大小，如果为0，则表示从偏移处到最尾，如果超出边界，则只到边界
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static void advise(mmap_t* ptr, int advice, size_t offset=0, size_t length=0);
+
 private:
-    static mmap_t* do_map(int prot, int fd, size_t size, size_t offset, size_t size_max, bool byfd);
+    static mmap_t* do_map(int prot, int fd, size_t size, size_t offset, size_t size_max, int map_flags, bool byfd);
 };
 
 /***
@@ -147,5 +165,75 @@ private:
     mmap_t* _ptr;
 };
 
+/***
+  * 以滑动窗口映射的方式顺序读文件，同一时刻只映射文件的一段（窗口），
+  * 读过窗口尾时解除映射并映射下一段，因此可读远大于地址空间预算的文件，
+  * 窗口以MADV_SEQUENTIAL映射，内核会加大预读并优先回收已读过的页。
+  * 读出的行或记录直接指向映射区，在下一次读之前有效。非线程安全。
+  *
+  * 使用示例：
+  * CMappedReader reader("/data/access.log");
+  * const char* line;
+  * size_t line_size;
+  * while (reader.next_line(&line, &line_size))
+  * {
+  *     // line不含结尾的换行符
+  * }
+  */
+class CMappedReader
+{
+public:
+    enum
+    {
+        reader_populate = 0x01,   /** 映射窗口时以MAP_POPULATE预读入整个窗口 */
+        reader_hugepage = 0x02,   /** 窗口使用透明大页（MADV_HUGEPAGE），不支持时忽略 */
+        reader_drop_behind = 0x04 /** 以POSIX_FADV_DONTNEED丢弃已读过的窗口的页缓存，避免挤出其它热数据 */
+    };
+
+public:
+    /***
+      * @window_size: 窗口大小，会向上对齐到页，一行或一条记录超过窗口时窗口临时扩大
+      * @flags: reader_populate、reader_hugepage和reader_drop_behind的组合
+      * @exception: 出错抛出CSyscallException异常
+      */
+    CMappedReader(const char* filename, size_t window_size=64*1024*1024, int flags=reader_drop_behind);
+    ~CMappedReader();
+
+    uint64_t get_file_size() const { return _file_size; }
+    uint64_t get_offset() const { return _offset; } /** 下一次读的位置 */
+    uint32_t get_remap_number() const { return _remap_number; } /** 映射窗口的次数 */
+    void seek(uint64_t offset);
+
+    /***
+      * 读下一行，line指向行首，line_size不含换行符，文件最后一行可以没有换行符
+      * @return: 已读到文件尾时返回false
+      * @exception: 出错抛出CSyscallException异常
+      */
+    bool next_line(const char** line, size_t* line_size);
+
+    /***
+      * 读下一条定长的记录
+      * @return: 剩余不足record_size字节时返回false
+      * @exception: 出错抛出CSyscallException异常
+      */
+    bool next_record(const char** record, size_t record_size);
+
+private:
+    void remap(uint64_t offset, size_t size);
+    void unmap_window();
+
+private:
+    int _fd;
+    int _flags;
+    uint64_t _file_size;
+    size_t _window_size;
+    char* _window;           /** 映射的窗口，对应文件中的[_window_offset, _window_offset+_window_len) */
+    uint64_t _window_offset; /** 页对齐 */
+    size_t _window_len;
+    uint64_t _offset;
+    uint64_t _dropped_offset; /** 此前的页缓存已被丢弃 */
+    uint32_t _remap_number;
+};
+
 SYS_NAMESPACE_END
 #endif // MOOON_SYS_MMAP_H
@@ -19,6 +19,7 @@
 #ifndef MOOON_SYS_MYSQL_DB_H
 #define MOOON_SYS_MYSQL_DB_H
 #include "mooon/sys/simple_db.h"
+#include <map>
 #include <stdarg.h>
 
 #if MOOON_HAVE_MYSQL==1
@@ -50,6 +51,110 @@ SYS_NAMESPACE_BEGIN
 //     return 0;
 // }
 
+/**
+ * MySQL服务端预处理语句，由CMySQLConnection::prepare创建，
+ * 语句只在服务端解析一次，之后每次执行只传参数，参数不需要转义，也不经过格式化。
+ *
+ * 参数以“?”占位，按从0开始的序号绑定，
+ * 数值参数被复制，字符串参数只引用不复制，须在execute返回前保持有效，
+ * 绑定一直有效，直到被再次绑定，因此每次执行只需重新绑定变化的参数。
+ *
+ * 查询类语句执行后，以fetch逐行从服务端读取，字段按类型存放在各自的缓冲区中，
+ * 整数类型的字段可直接以get_int和get_uint取得，浮点类型的以get_double取得，不需要转换。
+ *
+ * 使用示例：
+ * CMySQLStatement* stmt = mysql.prepare("INSERT INTO test (id,name) VALUES (?,?)");
+ * stmt->bind_int(0, 2019);
+ * stmt->bind_string(1, name);
+ * stmt->execute();
+ *
+ * stmt = mysql.prepare("SELECT id,name FROM test WHERE id>?");
+ * stmt->bind_int(0, 2019);
+ * stmt->execute();
+ * while (stmt->fetch())
+ *     printf("%" PRId64": %s\n", stmt->get_int(0), stmt->get_string(1).c_str());
+ */
+class CMySQLStatement
+{
+    friend class CMySQLConnection;
+
+public:
+    ~CMySQLStatement();
+
+    const std::string& get_sql() const { return _sql; }
+    int get_param_number() const;
+    int get_field_number() const;
+
+    /** 绑定参数，index为参数的序号 */
+    void bind_null(int index);
+    void bind_int(int index, int64_t value);
+    void bind_uint(int index, uint64_t value);
+    void bind_double(int index, double value);
+    void bind_string(int index, const char* data, size_t size);
+    void bind_string(int index, const std::string& value) { bind_string(index, value.data(), value.size()); }
+
+    /***
+      * 以当前绑定的参数执行，
+      * 上一次执行的结果集如果还没读完，则被丢弃
+      * @return: 非查询类语句返回影响的行数，查询类语句返回0
+      * @exception: 出错抛出CDBException异常
+      */
+    uint64_t execute();
+
+    /** 取得上一次执行INSERT得到的自增值 */
+    uint64_t get_insert_id() const;
+
+    /***
+      * 取结果集的下一行
+      * @return: 没有更多的行时返回false
+      * @exception: 出错抛出CDBException异常
+      */
+    bool fetch();
+
+    /** 取当前行的字段值，index为字段的序号，字段为NULL时数值返回0，字符串返回空 */
+    bool is_null(int index) const;
+    int64_t get_int(int index) const;
+    uint64_t get_uint(int index) const;
+    double get_double(int index) const;
+    std::string get_string(int index) const;
+    DBField get_field(int index) const; // 视图只在下一次fetch前有效，数值类型的字段以文本表示
+
+private:
+    struct StatementData;
+
+private:
+    CMySQLStatement(void* mysql_handle, const std::string& sql);
+    void prepare();
+    void release();
+    void bind_result();
+    void check_param_index(int index) const;
+
+private:
+    void* _mysql_handle;
+    std::string _sql;
+    StatementData* _data;
+};
+
+/**
+ * LOAD DATA LOCAL INFILE的数据源，由CMySQLConnection::load_data_local在语句执行期间调用，
+ * 用于边读边解压等不直接把本地文件交给客户端库的场合，
+ * 在客户端库的回调中调用，不能抛出异常
+ */
+class CLocalInfileReader
+{
+public:
+    virtual ~CLocalInfileReader() {}
+
+    /***
+      * 读取最多size字节到buffer中
+      * @return: 读取的字节数，0表示已读完，-1表示出错
+      */
+    virtual int read(char* buffer, unsigned int size) = 0;
+
+    /** read出错时的出错信息，作为语句的出错信息 */
+    virtual std::string get_error() const { return "read local infile failed"; }
+};
+
 /**
  * MySQL版本的DB连接
  */
@@ -68,7 +173,10 @@ public:
     // 单引号转成：\'
     // 单斜杠转成双斜杠
     // 注意不转义空格、|、?、<、>、{、}、:、~、@、!、(、)、`、#、%、,、;、&、-和_等
+    // 以向量指令转义（utils::CStringSimd::escape_mysql），和mysql_escape_string一样不考虑字符集
     static void escape_string(const std::string& str, std::string* escaped_str);
+    // 转义结果的最大长度，不含结尾符
+    static size_t get_escape_size(size_t size) { return size * 2; }
 
 public:
     CMySQLConnection(size_t sql_max=8192, bool multistatements=false);
@@ -96,6 +204,13 @@ public:
     virtual bool is_ipsock_exception(CDBException& db_error) const;
 
     virtual std::string escape_string(const std::string& str) const;
+    virtual void append_escaped_string(const char* str, size_t size, std::string* out) const;
+
+    // 按连接的字符集转义，结果写入调用者提供的缓冲区，返回结果的长度，
+    // escaped的大小不能小于get_escape_size(size)+1，
+    // 字符集为utf8、utf8mb4、latin1、ascii或binary时以向量指令转义，否则调用mysql_real_escape_string，
+    // 出错抛出CDBException异常
+    size_t escape_string(const char* str, size_t size, char* escaped) const;
     virtual void change_charset(const std::string& charset);
     virtual void open();
     virtual void close() throw ();
@@ -144,15 +259,35 @@ public:
     // 注意fetch_results和have_more_results的调用顺序
     bool have_more_results() const;
 
+    // 允许执行LOAD DATA LOCAL INFILE，须在open之前调用，服务端的local_infile也须打开
+    void enable_local_infile(bool enabled=true) { _local_infile = enabled; }
+
+    // 执行LOAD DATA LOCAL INFILE语句，文件内容不从sql中的文件名读取，而由reader提供，
+    // 比逐批INSERT快得多，返回导入的行数，
+    // 出错抛出CDBException异常
+    uint64_t load_data_local(const std::string& sql, CLocalInfileReader* reader);
+
+    // 预处理以“?”为参数占位符的sql，结果缓存在连接中，同一sql再次prepare时直接返回缓存的语句，
+    // 返回的语句属于连接，不能delete，连接close或reopen时释放。
+    // 出错抛出CDBException异常
+    CMySQLStatement* prepare(const std::string& sql);
+
 private:
     virtual void do_query(DBTable& db_table, const char* sql, int sql_length);
 
+    // 以mysql_use_result逐行从服务端读取，
+    // 游标存在期间服务端为该连接保持结果集，应尽快读完，
+    // 未读完就删除游标时，mysql_free_result会读掉剩余的行
+    virtual DBCursor* do_open_cursor(const char* sql, int sql_length);
+
 private:
     void do_open();
 
 private:
     void* _mysql_handle; // MySQL句柄
     int _client_flag;
+    bool _local_infile;
+    std::map<std::string, CMySQLStatement*> _statements; // prepare缓存的语句，key为sql
 };
 
 SYS_NAMESPACE_END
@@ -20,6 +20,11 @@
 #define MOOON_SYS_OBJECT_POOL_H
 #include <mooon/utils/array_queue.h>
 #include "mooon/sys/lock.h"
+#include "mooon/sys/mem_tracker.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/utils.h"
+#include <string>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
 /***
@@ -65,6 +70,23 @@ private:
     uint32_t _index;    
 };
 
+/***
+  * 对象池的弹性策略，见CRawObjectPool::create_elastic
+  */
+struct CObjectPoolPolicy
+{
+    uint32_t chunk_size;          /** 池中对象用完时一次增加的对象个数（一个slab），0表示不扩容 */
+    uint32_t max_object_number;   /** 对象总数的上限（含create_elastic时创建的），达到后才按use_heap从堆中创建 */
+    uint32_t window_milliseconds; /** 缩容窗口，每个窗口结束时按窗口内借出数的高水位缩容 */
+    std::string name;             /** 非空时输出度量：object_pool.<name>.objects、borrowed、high_water_mark、heap（在adjust时更新），
+                                      以及计数器grow、shrink和heap_allocations */
+
+    CObjectPoolPolicy()
+        : chunk_size(0), max_object_number(0), window_milliseconds(60*1000)
+    {
+    }
+};
+
 /***
   * 裸对象池实现，性能高但非线程安全
   * 要求ObjectClass类必须是CPoolObject的子类
@@ -75,14 +97,30 @@ class CRawObjectPool
 public:
     /***
       * 构造一个非线程安全的裸对象池
-      * @use_heap: 当对象池中无对象时，是否从堆中创建对象
+      * @use_heap: 当对象池中无对象（弹性时已达到上限）时，是否从堆中创建对象
       */
     CRawObjectPool(bool use_heap) throw ()
         :_use_heap(use_heap)
+        ,_numa_node(-1)
         ,_object_number(0)
+        ,_pool_size(0)
         ,_avaliable_number(0)
+        ,_borrowed_number(0)
+        ,_heap_number(0)
+        ,_high_water_mark(0)
+        ,_chunk_number(0)
+        ,_free_chunk(0)
+        ,_window_start_milliseconds(0)
         ,_object_array(NULL)
         ,_object_queue(NULL)
+        ,_mem_tracker(NULL)
+        ,_objects_gauge(NULL)
+        ,_borrowed_gauge(NULL)
+        ,_high_water_mark_gauge(NULL)
+        ,_heap_gauge(NULL)
+        ,_grow_counter(NULL)
+        ,_shrink_counter(NULL)
+        ,_heap_counter(NULL)
     {
     }
 
@@ -95,13 +133,18 @@ public:
     /***
       * 创建对象池
       * @object_number: 需要创建的对象个数
+      * @numa_node: 对象数组优先放在该NUMA节点上，通常为CPoolThread::get_numa_node()，-1表示不指定
       */
-    void create(uint32_t object_number) throw ()
+    void create(uint32_t object_number, int numa_node=-1) throw ()
     {
+        _numa_node = numa_node;
         _object_number = object_number;
+        _pool_size = object_number;
         _avaliable_number = _object_number;
 
         _object_array = new ObjectClass[_object_number];
+        if (numa_node >= 0) // 构造时已访问过的页会被迁移
+            (void)CUtils::bind_numa_node(_object_array, sizeof(ObjectClass)*_object_number, numa_node);
         _object_queue = new utils::CArrayQueue<ObjectClass*>(_object_number);
         
         for (uint32_t i=0; i<_object_number; ++i)
@@ -114,14 +157,52 @@ public:
         }
     }
 
+    /***
+      * 创建弹性对象池，先创建object_number个对象（不会被释放），用完时一次增加policy.chunk_size个，
+      * 增加的对象同样有有效的序号，直到总数达到policy.max_object_number，之后才按use_heap从堆中创建，
+      * 这样突发的借用不会逐个new和delete。
+      *
+      * 借用时总是先用create_elastic时创建的对象，再按顺序用各slab的，使靠后的slab容易整个空闲；
+      * 缩容由adjust完成，须由使用者定期调用（如在同一线程的定时器中），
+      * 每个窗口结束时，若总数减去一个slab后仍不少于“窗口内借出数的高水位+一个slab”，则释放一个完全空闲的slab，
+      * 重复直到不满足，即至少保留一个slab的余量，避免负载在高水位附近波动时反复扩缩。
+      */
+    void create_elastic(uint32_t object_number, const CObjectPoolPolicy& policy, int numa_node=-1)
+    {
+        create(object_number, numa_node);
+        _policy = policy;
+        _window_start_milliseconds = CClock::get_milliseconds();
+
+        if ((policy.chunk_size > 0) && (policy.max_object_number > object_number))
+            _chunks.resize((policy.max_object_number - object_number) / policy.chunk_size);
+        if (!policy.name.empty())
+        {
+            const std::string prefix = "object_pool." + policy.name + ".";
+            _objects_gauge = CMetricsRegistry::get_singleton()->get_gauge(prefix + "objects");
+            _borrowed_gauge = CMetricsRegistry::get_singleton()->get_gauge(prefix + "borrowed");
+            _high_water_mark_gauge = CMetricsRegistry::get_singleton()->get_gauge(prefix + "high_water_mark");
+            _heap_gauge = CMetricsRegistry::get_singleton()->get_gauge(prefix + "heap");
+            _grow_counter = CMetricsRegistry::get_singleton()->get_counter(prefix + "grow");
+            _shrink_counter = CMetricsRegistry::get_singleton()->get_counter(prefix + "shrink");
+            _heap_counter = CMetricsRegistry::get_singleton()->get_counter(prefix + "heap_allocations");
+            update_gauges();
+        }
+    }
+
     /** 销毁对象池 */
     void destroy() throw ()
     {
+        for (typename std::vector<struct Chunk>::size_type i=0; i<_chunks.size(); ++i)
+            release_chunk(i);
+        _chunks.clear();
+
         delete _object_queue;
         delete []_object_array;
 
         _object_queue = NULL;
         _object_array = NULL;
+        _pool_size = 0;
+        _avaliable_number = 0;
     }
 
     /***
@@ -134,22 +215,37 @@ public:
     {
         ObjectClass* object = NULL;
         
-        // 如果队列为空，则看是否从堆中创建新对象，如果不可以，则返回NULL
-        if (_object_queue->is_empty()) 
+        // 如果队列为空，则先从各slab中取，还不行再看是否从堆中创建新对象，如果不可以，则返回NULL
+        if (!_object_queue->is_empty())
         {
-            if (_use_heap)
-            {
-                object = new ObjectClass;
-                object->set_index(0); // index为0，表示不是对象池中的对象
-            }
+            object = _object_queue->pop_front();
         }
-        else
+        else if (!_chunks.empty())
+        {
+            object = borrow_from_chunks();
+        }
+
+        if (object != NULL)
         {
-            object = _object_queue->pop_front();
             object->set_in_pool(false);
             --_avaliable_number;
-        }        
+        }
+        else if (_use_heap)
+        {
+            object = new ObjectClass;
+            object->set_index(0); // index为0，表示不是对象池中的对象
+            ++_heap_number;
+            if (_heap_counter != NULL)
+                _heap_counter->inc();
+        }
 
+        if (object != NULL)
+        {
+            if (++_borrowed_number > _high_water_mark)
+                _high_water_mark = _borrowed_number;
+            if (_mem_tracker != NULL)
+                _mem_tracker->allocate(sizeof(ObjectClass));
+        }
         return object;
     }
 
@@ -160,10 +256,16 @@ public:
       */
     void pay_back(ObjectClass* object) throw ()
     {
-        // 如果是对象池中的对象
-        if (0 == object->get_index())
+        const uint32_t index = object->get_index();
+
+        // 如果不是对象池中的对象
+        if (0 == index)
         {       
+            if (_mem_tracker != NULL)
+                _mem_tracker->release(sizeof(ObjectClass));
             delete object;
+            --_heap_number;
+            --_borrowed_number;
         }
         else
         {
@@ -173,16 +275,77 @@ public:
                 object->reset();
                 object->set_in_pool(true);
 
-                _object_queue->push_back(object);
+                if (index <= _object_number)
+                {
+                    _object_queue->push_back(object);
+                }
+                else
+                {
+                    const uint32_t chunk_index = (index - _object_number - 1) / _policy.chunk_size;
+                    struct Chunk& chunk = _chunks[chunk_index];
+                    chunk.free_objects[chunk.free_number++] = object;
+                    if (chunk_index < _free_chunk)
+                        _free_chunk = chunk_index;
+                }
+
                 ++_avaliable_number;
+                --_borrowed_number;
+                if (_mem_tracker != NULL)
+                    _mem_tracker->release(sizeof(ObjectClass));
             }
         }
     }
 
-    /** 得到总的对象个数，包括已经借出的和未借出的 */
+    /***
+      * 窗口结束时按高水位释放完全空闲的slab，并开始新的窗口，同时更新度量，非弹性对象池时只更新度量
+      * @now_milliseconds: 当前的单调时间（毫秒），为0时取CClock::get_milliseconds()
+      * @return: 释放的slab个数
+      */
+    int adjust(uint64_t now_milliseconds=0)
+    {
+        int number = 0;
+
+        if (0 == now_milliseconds)
+            now_milliseconds = CClock::get_milliseconds();
+        if (!_chunks.empty() && (now_milliseconds - _window_start_milliseconds >= _policy.window_milliseconds))
+        {
+            const uint32_t chunk_size = _policy.chunk_size;
+            for (typename std::vector<struct Chunk>::size_type i=_chunks.size(); i>0; --i)
+            {
+                if (_pool_size < static_cast<uint64_t>(_high_water_mark) + chunk_size * 2)
+                    break;
+
+                struct Chunk& chunk = _chunks[i-1];
+                if ((chunk.objects != NULL) && (chunk.free_number == chunk_size))
+                {
+                    release_chunk(i-1);
+                    ++number;
+                }
+            }
+
+            _window_start_milliseconds = now_milliseconds;
+            _high_water_mark = _borrowed_number;
+            if ((number > 0) && (_shrink_counter != NULL))
+                _shrink_counter->inc(number);
+        }
+
+        update_gauges();
+        return number;
+    }
+
+    /***
+      * 设置内存统计，之后借出的对象（含从堆上创建的）按sizeof(ObjectClass)计入tracker，归还时减去，
+      * 为NULL表示不统计（默认）
+      */
+    void set_mem_tracker(CMemTracker* mem_tracker) throw ()
+    {
+        _mem_tracker = mem_tracker;
+    }
+
+    /** 得到总的对象个数，包括已经借出的和未借出的，弹性时含各slab的，不含从堆上创建的 */
     uint32_t get_pool_size() const throw ()
     {
-        return _object_number;
+        return _pool_size;
     }
     
     /** 得到对象池中还未借出的对象个数 */
@@ -191,19 +354,153 @@ public:
         return _avaliable_number;
     }
 
+    /** 得到当前借出的对象个数，包括从堆中创建的 */
+    uint32_t get_borrowed_number() const throw ()
+    {
+        return _borrowed_number;
+    }
+
+    /** 得到当前从堆中创建且未归还的对象个数，持续不为0说明max_object_number偏小 */
+    uint32_t get_heap_number() const throw ()
+    {
+        return _heap_number;
+    }
+
+    /** 得到本窗口内借出对象个数的最大值（高水位），非弹性时为创建以来的 */
+    uint32_t get_high_water_mark() const throw ()
+    {
+        return _high_water_mark;
+    }
+
+    /** 得到当前的slab个数 */
+    uint32_t get_chunk_number() const throw ()
+    {
+        return _chunk_number;
+    }
+
+private:
+    struct Chunk
+    {
+        ObjectClass* objects;       // 为NULL表示该位置的slab未创建或已释放
+        ObjectClass** free_objects; // 空闲对象的栈，大小为chunk_size
+        uint32_t free_number;
+    };
+
+    // 从序号最小的有空闲对象的slab中取，都没有时在第一个空位置上创建一个slab
+    ObjectClass* borrow_from_chunks()
+    {
+        for (; _free_chunk<_chunks.size(); ++_free_chunk)
+        {
+            struct Chunk& chunk = _chunks[_free_chunk];
+            if ((chunk.objects != NULL) && (chunk.free_number > 0))
+                return chunk.free_objects[--chunk.free_number];
+        }
+
+        for (typename std::vector<struct Chunk>::size_type i=0; i<_chunks.size(); ++i)
+        {
+            if (NULL == _chunks[i].objects)
+            {
+                create_chunk(i);
+                _free_chunk = static_cast<uint32_t>(i);
+
+                struct Chunk& chunk = _chunks[i];
+                return chunk.free_objects[--chunk.free_number];
+            }
+        }
+        return NULL;
+    }
+
+    void create_chunk(typename std::vector<struct Chunk>::size_type chunk_index)
+    {
+        const uint32_t chunk_size = _policy.chunk_size;
+        const uint32_t first_index = _object_number + static_cast<uint32_t>(chunk_index) * chunk_size + 1;
+        struct Chunk& chunk = _chunks[chunk_index];
+
+        chunk.objects = new ObjectClass[chunk_size];
+        chunk.free_objects = new ObjectClass*[chunk_size];
+        chunk.free_number = chunk_size;
+        if (_numa_node >= 0)
+            (void)CUtils::bind_numa_node(chunk.objects, sizeof(ObjectClass)*chunk_size, _numa_node);
+
+        // 逆序入栈，使序号小的先被借出
+        for (uint32_t i=0; i<chunk_size; ++i)
+        {
+            ObjectClass* object = &chunk.objects[i];
+            object->set_index(first_index + i);
+            object->set_in_pool(true);
+            chunk.free_objects[chunk_size-i-1] = object;
+        }
+
+        ++_chunk_number;
+        _pool_size += chunk_size;
+        _avaliable_number = _avaliable_number + chunk_size;
+        if (_grow_counter != NULL)
+            _grow_counter->inc();
+    }
+
+    void release_chunk(typename std::vector<struct Chunk>::size_type chunk_index)
+    {
+        struct Chunk& chunk = _chunks[chunk_index];
+        if (NULL == chunk.objects)
+            return;
+
+        delete []chunk.free_objects;
+        delete []chunk.objects;
+        chunk.objects = NULL;
+        chunk.free_objects = NULL;
+        chunk.free_number = 0;
+
+        --_chunk_number;
+        _pool_size -= _policy.chunk_size;
+        _avaliable_number = _avaliable_number - _policy.chunk_size;
+    }
+
+    void update_gauges()
+    {
+        if (_objects_gauge != NULL)
+        {
+            _objects_gauge->set(_pool_size);
+            _borrowed_gauge->set(_borrowed_number);
+            _high_water_mark_gauge->set(_high_water_mark);
+            _heap_gauge->set(_heap_number);
+        }
+    }
+
 private:
     bool _use_heap;
-    uint32_t _object_number;
+    int _numa_node;
+    uint32_t _object_number; // create时创建的对象个数，序号为[1, _object_number]
+    uint32_t _pool_size;
     volatile uint32_t _avaliable_number;
+    uint32_t _borrowed_number;
+    uint32_t _heap_number;
+    uint32_t _high_water_mark;
+    uint32_t _chunk_number;
+    uint32_t _free_chunk; // 序号小于它的slab都没有空闲对象
+    uint64_t _window_start_milliseconds;
     ObjectClass* _object_array;
     utils::CArrayQueue<ObjectClass*>* _object_queue;
+    CMemTracker* _mem_tracker;
+
+private:
+    // 第i个slab中对象的序号为_object_number+i*chunk_size+1开始的chunk_size个，释放后该位置可再创建
+    CObjectPoolPolicy _policy;
+    std::vector<struct Chunk> _chunks;
+    CGauge* _objects_gauge;
+    CGauge* _borrowed_gauge;
+    CGauge* _high_water_mark_gauge;
+    CGauge* _heap_gauge;
+    CCounter* _grow_counter;
+    CCounter* _shrink_counter;
+    CCounter* _heap_counter;
 };
 
 /***
   * 线程安全的对象池，性能较CRawObjectPool低
   * 要求ObjectClass类必须是CPoolObject的子类
+  * LockClass为锁类型，借还都是很短的临界区，可使用spin_lock.h中的CAdaptiveLock等
   */
-template <class ObjectClass>
+template <class ObjectClass, class LockClass=CLock>
 class CThreadObjectPool
 {
 public: 
@@ -219,52 +516,289 @@ public:
     /***
       * 创建对象池
       * @object_number: 需要创建的对象个数
+      * @numa_node: 对象数组优先放在该NUMA节点上，-1表示不指定
       */
-    void create(uint32_t object_number)
+    void create(uint32_t object_number, int numa_node=-1)
+    {
+        LockHelper<LockClass> lock_helper(_lock);
+        _raw_object_pool.create(object_number, numa_node);
+    }
+
+    /** 创建弹性对象池，见CRawObjectPool::create_elastic */
+    void create_elastic(uint32_t object_number, const CObjectPoolPolicy& policy, int numa_node=-1)
     {
-        LockHelper<CLock> lock_helper(_lock);
-        _raw_object_pool.create(object_number);
+        LockHelper<LockClass> lock_helper(_lock);
+        _raw_object_pool.create_elastic(object_number, policy, numa_node);
     }
 
     /** 销毁对象池 */
     void destroy()
     {
-        LockHelper<CLock> lock_helper(_lock);
+        LockHelper<LockClass> lock_helper(_lock);
         _raw_object_pool.destroy();
     }
 
+    /** 按窗口内的高水位缩容，可在后台线程中定期调用，见CRawObjectPool::adjust */
+    int adjust(uint64_t now_milliseconds=0)
+    {
+        LockHelper<LockClass> lock_helper(_lock);
+        return _raw_object_pool.adjust(now_milliseconds);
+    }
+
     /** 向对象池借用一个对象 */
     ObjectClass* borrow()
     {
-        LockHelper<CLock> lock_helper(_lock);
+        LockHelper<LockClass> lock_helper(_lock);
         return _raw_object_pool.borrow();
     }
 
     /** 将一个对象归还给对象池 */
     void pay_back(ObjectClass* object)
     {
-        LockHelper<CLock> lock_helper(_lock);
+        LockHelper<LockClass> lock_helper(_lock);
         _raw_object_pool.pay_back(object);
     }
 
     /** 得到总的对象个数，包括已经借出的和未借出的 */
     uint32_t get_pool_size() const
     {
-        LockHelper<CLock> lock_helper(_lock);
+        LockHelper<LockClass> lock_helper(_lock);
         return _raw_object_pool.get_pool_size();
     }
     
     /** 得到对象池中还未借出的对象个数 */
     volatile uint32_t get_avaliable_number()
     {
-        LockHelper<CLock> lock_helper(_lock);
+        LockHelper<LockClass> lock_helper(_lock);
         return _raw_object_pool.get_avaliable_number();
     }
+
+    /** 得到当前借出的对象个数，包括从堆中创建的 */
+    uint32_t get_borrowed_number() const
+    {
+        LockHelper<LockClass> lock_helper(_lock);
+        return _raw_object_pool.get_borrowed_number();
+    }
+
+    /** 得到本窗口内借出对象个数的高水位 */
+    uint32_t get_high_water_mark() const
+    {
+        LockHelper<LockClass> lock_helper(_lock);
+        return _raw_object_pool.get_high_water_mark();
+    }
     
 private:
-    CLock _lock;
+    mutable LockClass _lock;
     CRawObjectPool<ObjectClass> _raw_object_pool;
 };
 
+/***
+  * 无锁的线程安全对象池，基于Treiber栈实现，借还对象都不需要加锁，
+  * 栈中的链接使用CPoolObject的序号而非指针，栈顶为“版本号+序号”组成的64位整数，
+  * 每次修改栈顶时版本号增一，以此避免ABA问题。
+  * 要求ObjectClass类必须是CPoolObject的子类，set_in_pool和reset的语义同CRawObjectPool。
+  */
+template <class ObjectClass>
+class CLockFreeObjectPool
+{
+public:
+    /***
+      * 构造一个无锁对象池
+      * @use_heap: 当对象池中无对象时，是否从堆中创建对象
+      */
+    CLockFreeObjectPool(bool use_heap) throw ()
+        :_use_heap(use_heap)
+        ,_object_number(0)
+        ,_top(0)
+        ,_avaliable_number(0)
+        ,_borrowed_number(0)
+        ,_high_water_mark(0)
+        ,_next_array(NULL)
+        ,_object_array(NULL)
+    {
+    }
+
+    ~CLockFreeObjectPool() throw ()
+    {
+        destroy();
+    }
+
+    /***
+      * 创建对象池，不能和borrow及pay_back并发调用
+      * @object_number: 需要创建的对象个数
+      * @numa_node: 对象数组优先放在该NUMA节点上，-1表示不指定
+      */
+    void create(uint32_t object_number, int numa_node=-1)
+    {
+        _object_number = object_number;
+        _avaliable_number = object_number;
+        _object_array = new ObjectClass[object_number];
+        _next_array = new uint32_t[object_number+1]; // 下标0不使用
+        if (numa_node >= 0)
+        {
+            (void)CUtils::bind_numa_node(_object_array, sizeof(ObjectClass)*object_number, numa_node);
+            (void)CUtils::bind_numa_node(_next_array, sizeof(uint32_t)*(object_number+1), numa_node);
+        }
+
+        // 序号i的下一个为i+1，最后一个的下一个为0，栈顶为序号1
+        for (uint32_t i=0; i<object_number; ++i)
+        {
+            ObjectClass* object = &_object_array[i];
+            object->set_index(i+1); // Index总是大于0，0作为无效标识
+            object->set_in_pool(true);
+            _next_array[i+1] = (i+1 == object_number)? 0: i+2;
+        }
+
+        __atomic_store_n(&_top, (object_number > 0)? 1: 0, __ATOMIC_RELEASE);
+    }
+
+    /** 销毁对象池，不能和borrow及pay_back并发调用 */
+    void destroy() throw ()
+    {
+        delete []_next_array;
+        delete []_object_array;
+
+        _next_array = NULL;
+        _object_array = NULL;
+        _top = 0;
+    }
+
+    /***
+      * 从对象池中借用一个对象，可被多个线程同时调用
+      * @return: 同CRawObjectPool::borrow
+      */
+    ObjectClass* borrow()
+    {
+        ObjectClass* object = NULL;
+        uint64_t top = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+
+        for (;;)
+        {
+            const uint32_t index = get_index(top);
+            if (0 == index)
+            {
+                if (_use_heap)
+                {
+                    object = new ObjectClass;
+                    object->set_index(0); // index为0，表示不是对象池中的对象
+                }
+
+                break;
+            }
+
+            // 读到的_next_array可能已过时，但那时栈顶的版本号必已改变，CAS会失败
+            const uint32_t next = __atomic_load_n(&_next_array[index], __ATOMIC_RELAXED);
+            if (__atomic_compare_exchange_n(&_top, &top, make_top(top, next), true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            {
+                object = &_object_array[index-1];
+                object->set_in_pool(false);
+                __atomic_sub_fetch(&_avaliable_number, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+
+        if (object != NULL)
+            update_high_water_mark(__atomic_add_fetch(&_borrowed_number, 1, __ATOMIC_RELAXED));
+        return object;
+    }
+
+    /***
+      * 将一个对象归还给对象池，可被多个线程同时调用，
+      * 但同一个对象不能被多个线程同时归还
+      */
+    void pay_back(ObjectClass* object)
+    {
+        const uint32_t index = object->get_index();
+
+        if (0 == index)
+        {
+            delete object;
+            __atomic_sub_fetch(&_borrowed_number, 1, __ATOMIC_RELAXED);
+        }
+        else if (!object->is_in_pool())
+        {
+            object->reset();
+            object->set_in_pool(true);
+
+            uint64_t top = __atomic_load_n(&_top, __ATOMIC_RELAXED);
+            do
+            {
+                __atomic_store_n(&_next_array[index], get_index(top), __ATOMIC_RELAXED);
+            } while (!__atomic_compare_exchange_n(&_top, &top, make_top(top, index), true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+            __atomic_add_fetch(&_avaliable_number, 1, __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&_borrowed_number, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    /** 得到总的对象个数，包括已经借出的和未借出的 */
+    uint32_t get_pool_size() const throw ()
+    {
+        return _object_number;
+    }
+
+    /** 得到对象池中还未借出的对象个数 */
+    uint32_t get_avaliable_number() const throw ()
+    {
+        return __atomic_load_n(&_avaliable_number, __ATOMIC_RELAXED);
+    }
+
+    /** 得到当前借出的对象个数，包括从堆中创建的 */
+    uint32_t get_borrowed_number() const throw ()
+    {
+        return __atomic_load_n(&_borrowed_number, __ATOMIC_RELAXED);
+    }
+
+    /** 得到借出对象个数的历史最大值（高水位），可用于确定合适的池大小 */
+    uint32_t get_high_water_mark() const throw ()
+    {
+        return __atomic_load_n(&_high_water_mark, __ATOMIC_RELAXED);
+    }
+
+    /** 将高水位重置为当前借出的对象个数 */
+    void reset_high_water_mark() throw ()
+    {
+        __atomic_store_n(&_high_water_mark, get_borrowed_number(), __ATOMIC_RELAXED);
+    }
+
+private:
+    static uint32_t get_index(uint64_t top)
+    {
+        return static_cast<uint32_t>(top & 0xFFFFFFFF);
+    }
+
+    // 版本号增一，并换上新的序号
+    static uint64_t make_top(uint64_t top, uint32_t index)
+    {
+        return (((top >> 32) + 1) << 32) | index;
+    }
+
+    void update_high_water_mark(uint32_t borrowed_number)
+    {
+        uint32_t high_water_mark = __atomic_load_n(&_high_water_mark, __ATOMIC_RELAXED);
+        while (borrowed_number > high_water_mark)
+        {
+            if (__atomic_compare_exchange_n(&_high_water_mark, &high_water_mark, borrowed_number, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+    }
+
+private:
+    CLockFreeObjectPool(const CLockFreeObjectPool&);
+    CLockFreeObjectPool& operator =(const CLockFreeObjectPool&);
+
+private:
+    bool _use_heap;
+    uint32_t _object_number;
+    char _pad0[CACHE_LINE_SIZE];
+    uint64_t _top; /** 高32位为版本号，低32位为栈顶对象的序号，0表示栈为空 */
+    char _pad1[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    uint32_t _avaliable_number;
+    uint32_t _borrowed_number;
+    uint32_t _high_water_mark;
+    uint32_t* _next_array; /** 栈中每个序号的下一个序号 */
+    ObjectClass* _object_array;
+};
+
 SYS_NAMESPACE_END
 #endif // MOOON_SYS_OBJECT_POOL_H
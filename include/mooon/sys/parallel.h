@@ -0,0 +1,364 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_PARALLEL_H
+#define MOOON_SYS_PARALLEL_H
+#include "mooon/sys/task_executor.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 并行算法：parallel_for、parallel_reduce、parallel_sort和parallel_pipeline，
+  * 在CTaskExecutor上执行，工具和服务不必再自己按线程数切分数据（如--threads个线程各处理一段），
+  * 执行器有多少个工作线程就用多少个。
+  *
+  * 1) 范围按grain_size切成块，块由调用者线程和提交到执行器的协助任务一起认领执行，
+  *    调用者只等待已被认领的块，所以在工作线程中嵌套调用不会因等待排队的协助任务而死锁
+  * 2) grain_size为0时，块数约为工作线程数的8倍，块太小时调度开销会超过计算本身
+  * 3) 以CCancellationToken取消，或某块抛出异常后，未开始的块不再执行，已开始的执行完，
+  *    异常在调用者线程中以CException重新抛出（取第一个）
+  * 4) executor为NULL时在调用者线程中串行执行
+  *
+  * 使用示例：
+  * struct Square
+  * {
+  *     std::vector<int>* values;
+  *     void operator ()(size_t begin, size_t end) const
+  *     {
+  *         for (size_t i=begin; i<end; ++i)
+  *             (*values)[i] *= (*values)[i];
+  *     }
+  * };
+  * Square square = { &values };
+  * mooon::sys::parallel_for(&executor, size_t(0), values.size(), square);
+  */
+
+/** 取消并行算法，可被多个线程同时使用，reset后可复用 */
+class CCancellationToken
+{
+public:
+    CCancellationToken(): _cancelled(false) {}
+
+    void cancel() { __atomic_store_n(&_cancelled, true, __ATOMIC_RELEASE); }
+    bool is_cancelled() const { return __atomic_load_n(&_cancelled, __ATOMIC_ACQUIRE); }
+    void reset() { __atomic_store_n(&_cancelled, false, __ATOMIC_RELEASE); }
+
+private:
+    bool _cancelled;
+};
+
+/***
+  * 并行执行的块的分配和等待，内部使用，
+  * 在堆上创建并以引用计数释放，因为晚开始的协助任务可能在调用者返回后才执行（这时已没有块可认领）
+  */
+class CParallelContext
+{
+public:
+    CParallelContext(uint32_t chunk_number, CCancellationToken* token);
+
+    /***
+      * 提交协助任务，调用者自己也执行块，直到所有块都完成
+      * @return: 所有块都执行了返回true，被取消时返回false
+      * @exception: 块抛出异常时，抛出带有其信息的CException异常
+      */
+    bool run(CTaskExecutor* executor);
+
+    /** 释放调用者的引用，最后一个引用释放时删除 */
+    void release();
+
+protected:
+    virtual ~CParallelContext() {}
+
+private:
+    virtual void run_chunk(uint32_t index) = 0;
+
+    // 协助任务
+    void help();
+
+    // 认领并执行块，直到没有未认领的块
+    void work();
+
+private:
+    CParallelContext(const CParallelContext&);
+    CParallelContext& operator =(const CParallelContext&);
+
+private:
+    const uint32_t _chunk_number;
+    CCancellationToken* _token;
+    uint32_t _next_chunk;
+    uint32_t _references;
+    bool _cancelled;       // 有块抛出异常或被取消
+
+private:
+    CLock _lock;
+    CEvent _event;         // 所有块都已完成
+    uint32_t _finished_number;
+    bool _failed;
+    int _errcode;
+    std::string _error;
+};
+
+/** 得到块大小，grain_size为0时按执行器的线程数决定 */
+inline size_t get_parallel_grain_size(CTaskExecutor* executor, size_t size, size_t grain_size)
+{
+    // 块数不超过2^31-1，认领时的计数不会溢出
+    const size_t min_grain_size = std::max<size_t>((size + 0x7FFFFFFEu) / 0x7FFFFFFFu, 1);
+    if (grain_size > 0)
+        return std::max(grain_size, min_grain_size);
+
+    const size_t chunk_number = (NULL == executor)? 1: (static_cast<size_t>(executor->get_worker_number()) + 1) * 8;
+    return std::max((size + chunk_number - 1) / chunk_number, min_grain_size);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// parallel_for
+
+template <typename Index, typename Body>
+class CParallelForContext: public CParallelContext
+{
+public:
+    CParallelForContext(Index begin, Index end, size_t grain_size, const Body& body, CCancellationToken* token)
+        : CParallelContext(static_cast<uint32_t>((static_cast<size_t>(end - begin) + grain_size - 1) / grain_size), token),
+          _begin(begin), _end(end), _grain_size(grain_size), _body(body)
+    {
+    }
+
+private:
+    virtual void run_chunk(uint32_t index)
+    {
+        const Index begin = static_cast<Index>(_begin + static_cast<size_t>(index) * _grain_size);
+        const Index end = (static_cast<size_t>(_end - begin) > _grain_size)? static_cast<Index>(begin + _grain_size): _end;
+        _body(begin, end);
+    }
+
+private:
+    const Index _begin;
+    const Index _end;
+    const size_t _grain_size;
+    const Body& _body;
+};
+
+/***
+  * 并行执行body(块的begin, 块的end)，所有块覆盖[begin, end)且不重叠
+  * @index: 整数类型
+  * @grain_size: 每块的元素个数，为0时自动决定
+  * @return: 被取消时返回false
+  * @exception: body抛出异常时抛出CException异常，和body抛出的CException有相同的错误码
+  */
+template <typename Index, typename Body>
+bool parallel_for(CTaskExecutor* executor, Index begin, Index end, const Body& body, size_t grain_size=0, CCancellationToken* token=NULL)
+{
+    if (!(begin < end))
+        return (NULL == token) || !token->is_cancelled();
+
+    const size_t size = static_cast<size_t>(end - begin);
+    grain_size = get_parallel_grain_size(executor, size, grain_size);
+
+    CParallelContext* context = new CParallelForContext<Index, Body>(begin, end, grain_size, body, token);
+    bool completed = false;
+    try
+    {
+        completed = context->run(executor);
+    }
+    catch (...)
+    {
+        context->release();
+        throw;
+    }
+
+    context->release();
+    return completed;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// parallel_reduce
+
+template <typename Index, typename Value, typename Body>
+struct ParallelReduceChunk
+{
+    const Body* body;
+    std::vector<Value>* partials;
+    Index begin;
+    size_t grain_size;
+
+    void operator ()(Index chunk_begin, Index chunk_end) const
+    {
+        (*partials)[static_cast<size_t>(chunk_begin - begin) / grain_size] = (*body)(chunk_begin, chunk_end);
+    }
+};
+
+/***
+  * 并行归约：每块以body(块的begin, 块的end)得到部分结果，再以combine按块的顺序合并，
+  * 所以combine只须满足结合律，不必满足交换律（如字符串拼接）
+  * @identity: 归约的初值，也是未执行的块的部分结果
+  * @exception: 同parallel_for
+  */
+template <typename Index, typename Value, typename Body, typename Combine>
+Value parallel_reduce(CTaskExecutor* executor, Index begin, Index end, const Value& identity, const Body& body, const Combine& combine,
+                      size_t grain_size=0, CCancellationToken* token=NULL)
+{
+    if (!(begin < end))
+        return identity;
+
+    const size_t size = static_cast<size_t>(end - begin);
+    grain_size = get_parallel_grain_size(executor, size, grain_size);
+
+    std::vector<Value> partials((size + grain_size - 1) / grain_size, identity);
+    ParallelReduceChunk<Index, Value, Body> reduce_chunk = { &body, &partials, begin, grain_size };
+    (void)parallel_for(executor, begin, end, reduce_chunk, grain_size, token);
+
+    Value value = identity;
+    for (typename std::vector<Value>::size_type i=0; i<partials.size(); ++i)
+        value = combine(value, partials[i]);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// parallel_sort
+
+template <typename Iterator, typename Compare>
+struct ParallelSortChunk
+{
+    Iterator first;
+    const Compare* comp;
+
+    void operator ()(size_t begin, size_t end) const
+    {
+        std::sort(first+begin, first+end, *comp);
+    }
+};
+
+// 每次合并相邻的两段（各run_size个元素），合并后为下一轮的一段
+template <typename Iterator, typename Compare>
+struct ParallelMergeChunk
+{
+    Iterator first;
+    const Compare* comp;
+    size_t size;
+    size_t run_size; // 每段的元素个数
+
+    void operator ()(size_t begin, size_t end) const
+    {
+        for (size_t i=begin; i<end; ++i)
+        {
+            const size_t left = i * 2 * run_size;
+            const size_t middle = left + run_size;
+            if (middle < size)
+                std::inplace_merge(first+left, first+middle, first+std::min(middle+run_size, size), *comp);
+        }
+    }
+};
+
+/***
+  * 并行排序，不稳定：先并行排序各块，再逐轮并行合并相邻的块，
+  * 最后一轮只有一个合并，所以加速比受限于最后几轮，数据少时直接调用std::sort
+  * @iterator: 随机访问迭代器
+  * @grain_size: 每块的元素个数，为0时自动决定
+  */
+template <typename Iterator, typename Compare>
+void parallel_sort(CTaskExecutor* executor, Iterator first, Iterator last, const Compare& comp, size_t grain_size=0)
+{
+    const size_t size = static_cast<size_t>(std::distance(first, last));
+    if (0 == grain_size)
+        grain_size = std::max<size_t>(get_parallel_grain_size(executor, size, 0) * 4, 4096);
+    if ((NULL == executor) || (size <= grain_size))
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    ParallelSortChunk<Iterator, Compare> sort_chunk = { first, &comp };
+    (void)parallel_for(executor, size_t(0), size, sort_chunk, grain_size);
+    for (size_t run_size=grain_size; run_size<size; run_size*=2)
+    {
+        ParallelMergeChunk<Iterator, Compare> merge_chunk = { first, &comp, size, run_size };
+        (void)parallel_for(executor, size_t(0), (size + 2*run_size - 1) / (2*run_size), merge_chunk, 1);
+    }
+}
+
+template <typename Iterator>
+void parallel_sort(CTaskExecutor* executor, Iterator first, Iterator last)
+{
+    parallel_sort(executor, first, last, std::less<typename std::iterator_traits<Iterator>::value_type>());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// parallel_pipeline
+
+template <typename Item, typename Transform>
+struct ParallelTransformChunk
+{
+    std::vector<Item>* items;
+    const Transform* transform;
+
+    void operator ()(size_t begin, size_t end) const
+    {
+        for (size_t i=begin; i<end; ++i)
+            (*transform)(&(*items)[i]);
+    }
+};
+
+/***
+  * 三段的流水线：input串行地产生数据，transform并行地处理，output按input的顺序串行地消费，
+  * 如从MySQL读一批行（input），转换或压缩（transform），再按顺序写入目标表或文件（output）。
+  * 按批执行：input读满一批（或读完）后并行transform，再依次output，之后读下一批，
+  * input和output只在调用者线程中调用，不需要加锁。
+  * @input: bool input(Item* item)，没有更多数据时返回false，item为上一批用过的对象，须重新赋值
+  * @transform: void transform(Item* item) const
+  * @output: void output(const Item& item)
+  * @batch_size: 每批的个数，为0时为工作线程数的16倍
+  * @return: output的个数
+  * @exception: 同parallel_for，input和output抛出的异常原样抛出
+  *
+  * 使用示例：
+  * uint64_t rows = mooon::sys::parallel_pipeline<Row>(&executor, reader, converter, writer);
+  */
+template <typename Item, typename Input, typename Transform, typename Output>
+uint64_t parallel_pipeline(CTaskExecutor* executor, Input& input, const Transform& transform, Output& output,
+                           size_t batch_size=0, CCancellationToken* token=NULL)
+{
+    if (0 == batch_size)
+        batch_size = (NULL == executor)? 16: (static_cast<size_t>(executor->get_worker_number()) + 1) * 16;
+
+    uint64_t output_number = 0;
+    std::vector<Item> items(batch_size);
+    ParallelTransformChunk<Item, Transform> transform_chunk = { &items, &transform };
+    bool more = true;
+    while (more && ((NULL == token) || !token->is_cancelled()))
+    {
+        size_t number = 0;
+        while ((number < batch_size) && (more = input(&items[number])))
+            ++number;
+        if (0 == number)
+            break;
+        if (!parallel_for(executor, size_t(0), number, transform_chunk, 1, token))
+            break;
+
+        for (size_t i=0; i<number; ++i)
+            output(static_cast<const Item&>(items[i]));
+        output_number += number;
+    }
+
+    return output_number;
+}
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_PARALLEL_H
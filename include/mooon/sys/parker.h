@@ -0,0 +1,91 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_PARKER_H
+#define MOOON_SYS_PARKER_H
+#include "mooon/sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/** 线程空闲时等待唤醒的方式 */
+typedef enum
+{
+    idle_block,      /** 直接睡眠（CPoolThread为CEvent，CEventLoop为阻塞的epoll_wait），默认 */
+    idle_busy_spin,  /** 一直自旋，不让出CPU，延迟最低，但一直占满一个CPU */
+    idle_spin_yield, /** 先自旋，再以sched_yield让出CPU但不睡眠 */
+    idle_spin_park   /** 先自旋，再让出几次CPU，最后在futex上睡眠 */
+} idle_strategy_t;
+
+/***
+  * 空闲策略，线程间交接要求个位数微秒时使用自旋的策略，
+  * 被唤醒的线程不用等调度器（通常要几十微秒），唤醒方在对方还在自旋时也没有系统调用，
+  * 代价是空闲时也占用CPU，所以线程数不能超过可独占的CPU数，并且通常要绑定CPU
+  */
+struct CIdleStrategy
+{
+    idle_strategy_t type;
+    uint32_t spin_number;  /** 自旋的次数，每次为一个pause指令（几十纳秒），idle_busy_spin不用 */
+    uint32_t yield_number; /** idle_spin_park在睡眠前sched_yield的次数 */
+
+    CIdleStrategy(idle_strategy_t type_=idle_block, uint32_t spin_number_=10000, uint32_t yield_number_=16)
+        : type(type_), spin_number(spin_number_), yield_number(yield_number_)
+    {
+    }
+};
+
+/***
+  * 低延迟的等待和唤醒，一个线程park等待，任意线程unpark唤醒，语义同Java的LockSupport：
+  * unpark给一个许可（多次unpark只算一个），park消费许可，没有许可时按空闲策略等待。
+  * 等待的线程在自旋时，unpark只是一次原子操作，只有对方已在futex上睡眠时才有系统调用。
+  * 单CPU时自旋改为让出CPU。
+  */
+class CParker
+{
+public:
+    CParker();
+
+    /***
+      * 等待许可，只能由一个线程调用
+      * @strategy: 空闲策略，idle_block等同于不自旋的idle_spin_park
+      * @milliseconds: 最长等待的毫秒数，为负数表示一直等待
+      * @return: 得到许可返回true，超时返回false（futex睡眠可能被信号等打断，也返回false）
+      */
+    bool park(const CIdleStrategy& strategy, int milliseconds);
+
+    /***
+      * 给出许可，可被任意线程调用
+      * @return: 如果有唤醒的系统调用（对方已在futex上睡眠）返回true
+      */
+    bool unpark();
+
+private:
+    bool try_consume()
+    {
+        int expected = 1;
+        return __atomic_compare_exchange_n(&_state, &expected, 0, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
+    bool sleep(int milliseconds);
+
+private:
+    int _state; /** 0: 没有许可，1: 有许可，-1: 正在futex上睡眠 */
+    bool _multi_cpu; /** 单CPU时不自旋 */
+    char _pad[CACHE_LINE_SIZE - sizeof(int) - sizeof(bool)]; // 唤醒方只写_state，避免和相邻数据伪共享
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_PARKER_H
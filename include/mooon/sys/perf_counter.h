@@ -0,0 +1,181 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_PERF_COUNTER_H
+#define MOOON_SYS_PERF_COUNTER_H
+#include "mooon/sys/config.h"
+#include <string>
+SYS_NAMESPACE_BEGIN
+
+/** CPerfCounters计数的事件，也是perf_values_t::values的下标 */
+enum PerfEvent
+{
+    perf_cycles = 0,        /** CPU周期数 */
+    perf_instructions,      /** 退休的指令数，与周期数之比即IPC */
+    perf_cache_misses,      /** 末级缓存未命中数 */
+    perf_branch_misses,     /** 分支预测失败数 */
+    perf_context_switches,  /** 上下文切换次数（软件事件，总是可用） */
+    PERF_EVENT_MAX
+};
+
+/***
+  * 一组计数器的值，由CPerfCounters::read读取或由CPerfScope累计
+  */
+typedef struct TPerfValues
+{
+    uint64_t values[PERF_EVENT_MAX];
+    uint32_t available; /** 可用的计数器，第n位为1表示values[n]有效，不支持的硬件（如多数虚拟机）为0 */
+
+    TPerfValues();
+    void clear();
+
+    bool has(PerfEvent event) const { return (available & (1U << event)) != 0; }
+    uint64_t get(PerfEvent event) const { return values[event]; }
+
+    /** 累加other，可用的计数器取两者的并集 */
+    void add(const TPerfValues& other);
+
+    /** 得到this-start，计数器在两次读取之间不会变小，变小时（如被重置）为0 */
+    TPerfValues sub(const TPerfValues& start) const;
+
+    /** 输出可用的计数器，如：{"cycles":123,"instructions":456} */
+    std::string to_json() const;
+    std::string to_string() const;
+
+    /** 得到事件名，如cycles、cache_misses */
+    static const char* get_name(PerfEvent event);
+}perf_values_t;
+
+/***
+  * perf_event_open的封装，以一个组打开周期、指令、缓存未命中、分支预测失败和上下文切换计数器，
+  * 所有计数器同时启停，一次read(PERF_FORMAT_GROUP)读出全部的值，一次读取约为一次系统调用的开销（约1微秒）。
+  *
+  * 只计当前线程（open时的调用线程）在用户态的事件，include_kernel为true时也计核心态
+  * （受/proc/sys/kernel/perf_event_paranoid限制，默认不允许普通用户计核心态），
+  * 计数器被多路复用（同时使用的计数器多于硬件的个数）时按运行时间比例放大。
+  * 不支持的计数器（如虚拟机和容器中通常没有硬件计数器）被跳过，以perf_values_t::available区分。
+  *
+  * 非线程安全，每个线程须使用自己的CPerfCounters。
+  *
+  * 使用示例：
+  * mooon::sys::CPerfCounters counters;
+  * counters.open();
+  * mooon::sys::perf_values_t values;
+  * {
+  *     mooon::sys::CPerfScope scope(counters, &values);
+  *     ... // 被测的代码
+  * }
+  * printf("%s\n", values.to_string().c_str());
+  */
+class CPerfCounters
+{
+public:
+    CPerfCounters();
+    ~CPerfCounters();
+
+    /***
+      * 打开并启动计数器，已打开时先关闭
+      * @return: 至少有一个计数器可用时返回true，perf_event_open不可用时返回false
+      */
+    bool open(bool include_kernel=false);
+    void close();
+    bool is_open() const { return _leader_fd != -1; }
+
+    /** 得到可用的计数器，同perf_values_t::available */
+    uint32_t get_available() const { return _available; }
+
+    /***
+      * 读取从open起的累计值
+      * @return: 未打开或读取失败时返回false，values被清空
+      */
+    bool read(perf_values_t* values) const;
+
+private:
+    CPerfCounters(const CPerfCounters&);
+    CPerfCounters& operator =(const CPerfCounters&);
+
+private:
+    int _leader_fd;
+    int _fds[PERF_EVENT_MAX];
+    uint32_t _available;
+    int _number;                    // 组内计数器的个数
+    int _positions[PERF_EVENT_MAX]; // 各事件在read结果中的位置，不可用的为-1
+};
+
+/***
+  * 计数器的秒表，用法同CStopWatch：
+  * CPerfStopWatch stop_watch(counters);
+  * ... // 被测的代码
+  * stop_watch.get_elapsed(&values); // 自构造或上次restart以来的增量
+  */
+class CPerfStopWatch
+{
+public:
+    CPerfStopWatch(const CPerfCounters& counters)
+        : _counters(counters)
+    {
+        restart();
+    }
+
+    // 重新开始计数
+    void restart()
+    {
+        (void)_counters.read(&_start_values);
+    }
+
+    // 得到增量，restart为true时之后重新开始计数
+    void get_elapsed(perf_values_t* values, bool restart=true)
+    {
+        perf_values_t stop_values;
+        (void)_counters.read(&stop_values);
+        *values = stop_values.sub(_start_values);
+        if (restart)
+            _start_values = stop_values;
+    }
+
+private:
+    const CPerfCounters& _counters;
+    perf_values_t _start_values;
+};
+
+/***
+  * 计数一个代码区域：构造时读取一次，析构时再读取一次，增量累加到result，
+  * 同一个result可用于多次进入的区域（如循环中），得到所有进入的总和
+  */
+class CPerfScope
+{
+public:
+    CPerfScope(const CPerfCounters& counters, perf_values_t* result)
+        : _stop_watch(counters), _result(result)
+    {
+    }
+
+    ~CPerfScope()
+    {
+        perf_values_t values;
+        _stop_watch.get_elapsed(&values, false);
+        _result->add(values);
+    }
+
+private:
+    CPerfStopWatch _stop_watch;
+    perf_values_t* _result;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_PERF_COUNTER_H
@@ -19,6 +19,7 @@
 #ifndef MOOON_SYS_POOL_THREAD_H
 #define MOOON_SYS_POOL_THREAD_H
 #include "mooon/sys/event.h"
+#include "mooon/sys/parker.h"
 #include "mooon/sys/syscall_exception.h"
 #include "mooon/sys/thread.h"
 SYS_NAMESPACE_BEGIN
@@ -34,6 +35,7 @@ private:
     public:
         CPoolThreadHelper(CPoolThread* pool_thread);
         void millisleep(int milliseconds);
+        bool is_stopped() const { return is_stop(); }
 
     private:
         virtual void run();
@@ -49,7 +51,8 @@ protected: // 禁止直接创建CPoolThread的实例
     virtual ~CPoolThread();
     /***
       * 毫秒级sleep，线程可以调用它进入睡眠状态，并且可以通过调用wakeup唤醒，
-      * 请注意只本线程可以调用此函数，其它线程调用无效
+      * 请注意只本线程可以调用此函数，其它线程调用无效，
+      * 按set_idle_strategy设置的策略等待，自旋的策略可能提前返回
       */
     void do_millisleep(int milliseconds);
 
@@ -82,6 +85,9 @@ private:
 
     /** 设置线程在池中的顺序号 */
     void set_index(uint16_t index) { _index = index; }    
+
+    /** 设置线程所在的NUMA节点，由CThreadPool根据放置策略设置 */
+    void set_numa_node(int numa_node) { _numa_node = numa_node; }
     
 public:
     /** 设置参数，在before_start之前被回调 */
@@ -94,6 +100,14 @@ public:
       */
     void wakeup();
 
+    /***
+      * 设置do_millisleep和wakeup的空闲策略，须在start之前（如before_start中）设置，
+      * 默认为idle_block，即CEvent的等待和唤醒；自旋的策略以CParker等待和唤醒，
+      * 唤醒时本线程还在自旋则没有系统调用，用于线程间要求微秒级交接的场合
+      */
+    void set_idle_strategy(const CIdleStrategy& idle_strategy) { _idle_strategy = idle_strategy; }
+    const CIdleStrategy& get_idle_strategy() const { return _idle_strategy; }
+
     /***
       * 得到池线程在线程池中的序号，序号从0开始，
       * 且连续，但总是小于线程个数值。
@@ -111,6 +125,29 @@ public:
       */
     size_t get_stack_size() const;
 
+    /** 设置线程绑定的CPU，应当在before_start中或之前设置，
+      * 通常由CThreadPool::create根据放置策略设置，before_start中可再修改
+      * @cpus: CPU编号列表，为空表示不绑定
+      */
+    void set_cpu_affinity(const std::vector<int>& cpus);
+
+    /** 得到线程绑定的CPU列表，为空表示未绑定 */
+    const std::vector<int>& get_cpu_affinity() const;
+
+    /** 设置线程名，应当在before_start中或之前设置，
+      * 通常由CThreadPool::create按“<池名>.<序号>”设置，见CThread::set_name
+      */
+    void set_name(const std::string& name);
+    const std::string& get_name() const;
+
+    /***
+      * 得到线程所在的NUMA节点，池线程可据此分配本节点的内存，如：
+      * _mem_pool.create(bucket_size, bucket_number, true, 1, 'm', get_numa_node());
+      * 在set_parameter和before_start中即可使用
+      * @return: 未按NUMA放置时返回-1
+      */
+    int get_numa_node() const throw () { return _numa_node; }
+
     /** 得到本线程号 */
     uint32_t get_thread_id() const throw ();
 
@@ -120,7 +157,10 @@ private:
 	
 private:	
     uint16_t _index;  /** 池线程在池中的位置 */
+    int _numa_node;   /** 所在的NUMA节点，-1表示未指定 */
     CPoolThreadHelper* _pool_thread_helper;	
+    CIdleStrategy _idle_strategy;
+    CParker _parker;  /** 非idle_block时用于等待和唤醒 */
 };
 
 
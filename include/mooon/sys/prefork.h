@@ -0,0 +1,159 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_PREFORK_H
+#define MOOON_SYS_PREFORK_H
+#include "mooon/sys/thread_placement.h"
+#include <signal.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+class CGauge;
+
+/***
+  * 预派生（pre-fork）的工作进程，run_worker在子进程中被调用
+  */
+class IPreforkWorker
+{
+public:
+    virtual ~IPreforkWorker() {}
+
+    /***
+      * 工作进程的主体，返回即退出工作进程，返回值为进程退出码，
+      * 进程开始时信号掩码已恢复为调用CPreforkSupervisor::run之前的，
+      * 收到SIGTERM时应尽快退出（如以net::CSignalFd在事件循环中处理SIGTERM），
+      * 抛出的CException被记录日志后以1退出
+      * @worker_index: 工作进程序号，重启的进程沿用原来的序号
+      */
+    virtual int run_worker(uint16_t worker_index) = 0;
+};
+
+/***
+  * 多进程模型的监管者，用于不能多线程的场合（如有非线程安全的C扩展），仍可用满所有CPU：
+  * 1) 主进程在run之前创建监听（如以net::CListenManager），工作进程继承监听fd共同accept，
+  *    也可以由各工作进程在run_worker中以SO_REUSEPORT各自监听，由内核在进程间分配连接
+  * 2) 按CThreadPlacement将第i个工作进程绑定到其第i个CPU集合
+  * 3) 工作进程退出后自动重启，运行不足get_min_uptime_milliseconds就退出的，重启间隔逐次加倍，
+  *    以免启动即崩溃时反复fork
+  * 4) 每个工作进程在共享内存（fork前以MAP_SHARED映射）中有独占缓存行的计数器，
+  *    工作进程以add_counter累加，主进程定时汇总到CMetricsRegistry：
+  *    当前值prefork.<名字>为所有工作进程之和，prefork.worker<序号>.<名字>为各工作进程的，
+  *    另有prefork.restarts和prefork.workers
+  * 5) 主进程收到SIGTERM或SIGINT时向工作进程发送SIGTERM，超时未退出的发送SIGKILL，
+  *    收到SIGHUP时转发给所有工作进程（如用于重新加载配置），
+  *    工作进程设置了PR_SET_PDEATHSIG，主进程意外退出时工作进程收到SIGTERM
+  *
+  * 使用示例：
+  * mooon::net::CListenManager<mooon::net::CListener> listen_manager;
+  * listen_manager.add("0.0.0.0", 8080);
+  * listen_manager.create();
+  * std::vector<std::string> counter_names(1, "requests");
+  * mooon::sys::CPreforkSupervisor supervisor(&worker, 4, mooon::sys::CThreadPlacement(mooon::sys::placement_compact), counter_names);
+  * supervisor.run(); // 工作进程中：supervisor.add_counter(0);
+  */
+class CPreforkSupervisor
+{
+public:
+    /***
+      * @worker: 工作进程的主体
+      * @worker_number: 工作进程个数，为0时取CPU个数
+      * @placement: 工作进程的CPU绑定策略
+      * @counter_names: 共享内存中每个工作进程的计数器名字，下标即add_counter的index
+      */
+    CPreforkSupervisor(IPreforkWorker* worker, uint16_t worker_number,
+                       const CThreadPlacement& placement=CThreadPlacement(),
+                       const std::vector<std::string>& counter_names=std::vector<std::string>());
+    ~CPreforkSupervisor();
+
+    /***
+      * 在主进程中运行：派生所有工作进程，监管直到stop或收到SIGTERM/SIGINT，
+      * 返回前所有工作进程都已退出
+      * @exception: 映射共享内存或设置信号掩码出错时抛出CSyscallException异常
+      */
+    void run();
+
+    /** 可在其它线程中调用，run在100毫秒内开始停止工作进程 */
+    void stop();
+
+    /** 设置重启间隔：第一次的毫秒数，和逐次加倍的上限 */
+    void set_restart_milliseconds(uint32_t milliseconds, uint32_t max_milliseconds);
+
+    /** 设置停止时等待工作进程退出的最长毫秒数，超过后发送SIGKILL */
+    void set_stop_milliseconds(uint32_t milliseconds) { _stop_milliseconds = milliseconds; }
+
+    /** 工作进程运行多少毫秒以上退出时，视为正常运行过，重启间隔复位 */
+    uint32_t get_min_uptime_milliseconds() const { return 1000; }
+
+    uint16_t get_worker_number() const { return _worker_number; }
+
+public: // 工作进程中调用
+    /** 得到当前工作进程的序号，在主进程中返回-1 */
+    int get_worker_index() const { return _worker_index; }
+
+    /** 累加当前工作进程的第index个计数器，在主进程中调用无效 */
+    void add_counter(uint32_t index, uint64_t number=1);
+
+public: // 主进程和工作进程都可调用
+    /** 得到第worker_index个工作进程的第index个计数器 */
+    uint64_t get_counter(uint16_t worker_index, uint32_t index) const;
+
+    /** 得到所有工作进程的第index个计数器之和 */
+    uint64_t get_total_counter(uint32_t index) const;
+
+    /** 得到第worker_index个工作进程的进程号，未运行时返回0 */
+    pid_t get_worker_pid(uint16_t worker_index) const;
+
+    /** 得到第worker_index个工作进程的重启次数 */
+    uint32_t get_restart_number(uint16_t worker_index) const;
+
+private:
+    struct WorkerSlot;
+    struct WorkerState;
+
+    WorkerSlot* get_slot(uint16_t worker_index) const;
+    void start_worker(uint16_t worker_index);
+    void run_worker(uint16_t worker_index);
+    void reap_workers();
+    void restart_workers(uint64_t now);
+    void stop_workers();
+    void kill_workers(int signo);
+    void publish_metrics();
+    int get_wait_milliseconds(uint64_t now) const;
+
+private:
+    IPreforkWorker* _worker;
+    uint16_t _worker_number;
+    CThreadPlacement _placement;
+    std::vector<std::string> _counter_names;
+    uint32_t _restart_milliseconds;
+    uint32_t _max_restart_milliseconds;
+    uint32_t _stop_milliseconds;
+    volatile bool _stop;
+    int _worker_index;
+    pid_t _master_pid;
+    sigset_t _old_sigset;                /** run之前的信号掩码，工作进程中恢复 */
+    size_t _slot_size;                   /** 每个工作进程的共享内存字节数，为缓存行的整数倍 */
+    char* _slots;                        /** MAP_SHARED的共享内存 */
+    std::vector<WorkerState> _states;    /** 主进程中各工作进程的重启状态 */
+    std::vector<CGauge*> _gauges;        /** 依次为各计数器之和、各工作进程的各计数器、重启次数和运行的工作进程数 */
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_PREFORK_H
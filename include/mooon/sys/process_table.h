@@ -0,0 +1,166 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_PROCESS_TABLE_H
+#define MOOON_SYS_PROCESS_TABLE_H
+#include "mooon/sys/config.h"
+#include <regex.h>
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/** 进程表中的一个进程，来自/proc/PID/stat和/proc/PID/cmdline */
+struct process_info_t
+{
+    int64_t pid;
+    int64_t ppid;
+    char state;                          /** 状态，如R、S、D、Z */
+    int32_t thread_number;
+    uint64_t utime;                      /** 用户态CPU时间，单位为时钟滴答（sysconf(_SC_CLK_TCK)） */
+    uint64_t stime;                      /** 内核态CPU时间，单位同utime */
+    uint64_t start_time;                 /** 启动时间，为系统启动后的时钟滴答数 */
+    uint64_t vsize;                      /** 虚拟内存的字节数 */
+    int64_t rss;                         /** 常驻内存的页数 */
+    std::string name;                    /** 进程名，同/proc/PID/comm（最长15个字符），set_process_name设置的名字有效 */
+    std::vector<std::string> parameters; /** 命令行参数，只有指定了PROCESS_CMDLINE才读取 */
+
+    process_info_t()
+        : pid(0), ppid(0), state('\0'), thread_number(0),
+          utime(0), stime(0), start_time(0), vsize(0), rss(0)
+    {
+    }
+};
+
+/***
+  * 进程过滤器，在完整解析之前调用，不符合的进程不再读取和解析其它内容，
+  * 多线程扫描时被并发调用，因此不能修改自身的状态
+  */
+class CProcessFilter
+{
+public:
+    virtual ~CProcessFilter() {}
+
+    /***
+      * 按进程名过滤，在只读取了stat时调用
+      * @name: 进程名，不以'\0'结尾
+      */
+    virtual bool match_name(int64_t pid, const char* name, size_t name_length) const { return true; }
+
+    /** 是否需要按命令行过滤，为true时才读取命令行并调用match_cmdline */
+    virtual bool need_cmdline() const { return false; }
+
+    /***
+      * 按命令行过滤，在match_name之后调用
+      * @cmdline: 原始的命令行，各参数以'\0'分隔
+      */
+    virtual bool match_cmdline(int64_t pid, const char* cmdline, size_t cmdline_length) const { return true; }
+};
+
+/***
+  * 按进程名（/proc/PID/comm）过滤，用于pidof和killall，
+  * 和CUtils::get_all_pid的匹配规则相同
+  */
+class CProcessNameFilter: public CProcessFilter
+{
+public:
+    /***
+      * @regex: 是否为扩展正则表达式
+      * @exception: 正则表达式不对时抛出utils::CException异常
+      */
+    CProcessNameFilter(const std::string& process_name, bool regex=false);
+    virtual ~CProcessNameFilter();
+
+    virtual bool match_name(int64_t pid, const char* name, size_t name_length) const;
+
+private:
+    const std::string _process_name;
+    const bool _regex;
+    regex_t _preg;
+};
+
+/***
+  * 进程表的快照，扫描/proc得到所有（或符合过滤器的）进程：
+  * 1) 以getdents64一次读取/proc的多个目录项，只取数字目录名，不分配字符串
+  * 2) 以openat相对/proc打开stat和cmdline，读入可复用的缓冲区中，只解析一次
+  * 3) 过滤器在完整解析之前调用，只有符合的进程才被完整解析和读取命令行
+  * 4) 进程多时可以多线程并行扫描，每个线程处理一段进程
+  *
+  * 扫描期间退出的进程被忽略，非线程安全，同一个对象不能被多个线程同时scan。
+  *
+  * 使用示例（pidof）：
+  * mooon::sys::CProcessTable process_table;
+  * mooon::sys::CProcessNameFilter filter("nginx");
+  * process_table.scan(0, 0, &filter);
+  * for (size_t i=0; i<process_table.get_process_number(); ++i)
+  *     printf("%" PRId64"\n", process_table.get_process(i).pid);
+  */
+class CProcessTable
+{
+public:
+    /** 扫描时读取的内容，stat总是读取的 */
+    enum
+    {
+        PROCESS_STAT = 0,
+        PROCESS_CMDLINE = 1 /** 读取命令行参数 */
+    };
+
+public:
+    CProcessTable();
+
+    /***
+      * 扫描/proc，结果替换之前的快照，按pid从小到大排序
+      * @fields: 读取的内容，PROCESS_STAT或PROCESS_CMDLINE
+      * @threads: 并行扫描的线程数，为0时根据进程数和CPU个数自动决定，为1时只在调用线程中扫描
+      * @filter: 过滤器，为NULL时取所有进程
+      * @return: 快照中的进程个数
+      * @exception: 打开或读取/proc出错时抛出CSyscallException异常
+      */
+    int scan(uint32_t fields=PROCESS_STAT, int threads=1, const CProcessFilter* filter=NULL);
+
+    size_t get_process_number() const { return _processes.size(); }
+    const process_info_t& get_process(size_t index) const { return _processes[index]; }
+    const std::vector<process_info_t>& get_processes() const { return _processes; }
+
+    /** 快照中的所有pid */
+    void get_pids(std::vector<int64_t>* pid_array) const;
+
+    /***
+      * 以getdents64列出/proc中的所有pid，未排序
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    static void list_pids(std::vector<int64_t>* pid_array);
+
+    /***
+      * 读取进程的原始命令行（各参数以'\0'分隔），不截断
+      * @pid: 为0时表示当前进程
+      * @return: 进程不存在或没有权限时返回false
+      */
+    static bool read_cmdline(int64_t pid, std::string* cmdline);
+
+    /** 将原始命令行分割成参数，忽略空参数，结果追加到parameters */
+    static void split_cmdline(const char* cmdline, size_t cmdline_length, std::vector<std::string>* parameters);
+
+public:
+    struct Worker;
+
+private:
+    std::vector<process_info_t> _processes;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_PROCESS_TABLE_H
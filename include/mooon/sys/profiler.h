@@ -0,0 +1,209 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_PROFILER_H
+#define MOOON_SYS_PROFILER_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/syscall_exception.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 进程内的CPU采样分析器，不依赖perf（容器中通常不允许perf_event_open）。
+  * 以setitimer(ITIMER_PROF)按进程消耗的CPU时间定时产生SIGPROF，
+  * 在信号处理函数中取调用栈，按栈聚合计数到预先分配的无锁表中，
+  * 信号处理函数中不分配内存也不加锁，表满时丢弃样本并计数。
+  *
+  * 停止后可得到折叠栈（collapsed stack）格式的结果，每行为：
+  * 根函数;...;叶子函数 样本数
+  * 可直接作为flamegraph.pl等火焰图工具的输入。
+  *
+  * 注意：
+  * 1) SIGPROF可能中断系统调用，没有SA_RESTART语义的调用（如epoll_wait）会返回EINTR
+  * 2) 编译时加上-fno-omit-frame-pointer或保留.eh_frame可使调用栈更完整
+  * 3) main_template中，CMainHelper的profile_signo信号可在运行时启停采样
+  */
+class CProfiler
+{
+public:
+    /***
+      * 开始采样，使用之前的结果将被清除
+      * @frequency: 每CPU秒的采样次数，实际不超过内核的时钟中断频率HZ
+      * @exception: 已在采样或出错时抛出CSyscallException异常
+      */
+    static void start(uint32_t frequency=100);
+
+    /** 停止采样，结果保留到下次start */
+    static void stop();
+
+    /** 是否正在采样 */
+    static bool is_running();
+
+    /** 得到采样数和因表满而丢弃的样本数 */
+    static uint64_t get_sample_number();
+    static uint64_t get_dropped_number();
+
+    /** 得到折叠栈格式的结果，函数名已经过demangle */
+    static std::string get_collapsed();
+
+    /***
+      * 将折叠栈格式的结果写入文件
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static void write_collapsed(const std::string& filename);
+};
+
+/***
+  * 一个已结束的追踪区间
+  */
+typedef struct TTraceSpan
+{
+    const char* name;     /** 区间名，须为字符串常量 */
+    uint64_t start_ns;    /** CClock::get_nanoseconds()的值 */
+    uint64_t duration_ns;
+    uint32_t thread_id;   /** 线程的内核ID（gettid） */
+    uint32_t depth;       /** 嵌套深度，最外层为0 */
+}trace_span_t;
+
+/***
+  * 轻量的区间追踪，每个线程一个固定大小的环形缓冲区，写满后覆盖最旧的区间。
+  * 未启用时MOOON_TRACE_SCOPE只有一次判断；启用时记录一个区间为两次读时钟和一次写本线程的缓冲区，不加锁。
+  */
+class CTracer
+{
+public:
+    /** 启用或停用追踪，默认停用 */
+    static void enable(bool enabled);
+    static bool is_enabled() { return __atomic_load_n(&_enabled, __ATOMIC_RELAXED); }
+
+    /***
+      * 进入和离开一个区间，通常不直接调用，而是使用MOOON_TRACE_SCOPE
+      * enter返回本线程当前的嵌套深度，leave记录区间并减少嵌套深度
+      */
+    static uint32_t enter();
+    static void leave(const char* name, uint64_t start_ns, uint32_t depth);
+
+    /***
+      * 取得所有线程当前缓冲区中的区间，按开始时间排序，
+      * 和写入并发时，正被覆盖的个别区间可能不完整
+      */
+    static void get_spans(std::vector<trace_span_t>* spans);
+
+    /** 清空所有线程的缓冲区 */
+    static void clear();
+
+    /***
+      * 以Chrome Trace Event格式（可用chrome://tracing或Perfetto打开）写入文件
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static void write_chrome_trace(const std::string& filename);
+
+private:
+    static bool _enabled;
+};
+
+/***
+  * 在作用域内记录一个区间
+  */
+class CTraceScope
+{
+public:
+    CTraceScope(const char* name)
+        : _name(name), _start_ns(0), _depth(0)
+    {
+        if (CTracer::is_enabled())
+        {
+            _depth = CTracer::enter();
+            _start_ns = CClock::get_nanoseconds();
+        }
+    }
+
+    ~CTraceScope()
+    {
+        if (_start_ns != 0)
+            CTracer::leave(_name, _start_ns, _depth);
+    }
+
+private:
+    const char* _name;
+    uint64_t _start_ns; // 为0表示开始时未启用追踪
+    uint32_t _depth;
+};
+
+#define MOOON_TRACE_CONCAT_(a, b) a##b
+#define MOOON_TRACE_CONCAT(a, b) MOOON_TRACE_CONCAT_(a, b)
+
+// 追踪当前作用域，name须为字符串常量，如：MOOON_TRACE_SCOPE("handle_request");
+#define MOOON_TRACE_SCOPE(name) \
+    ::mooon::sys::CTraceScope MOOON_TRACE_CONCAT(__mooon_trace_scope_, __LINE__)(name)
+
+/** 一把（或同名的多把）锁的争用统计，定义在profiler.cpp中 */
+class CLockContention;
+
+/***
+  * 锁争用分析，只分析以set_contention_name命名了的CLock和CReadWriteLock（库内的日志队列、内存池和事件队列等已命名），
+  * 未启用时加锁只多一次判断；启用后加锁先try_lock，失败时才计时等待，
+  * 等待的纳秒数计入直方图lock.<名字>.wait_ns，争用次数计入lock.<名字>.contended，
+  * 每sample_rate次争用取一次等待者的调用栈（CUtils::get_backtrace），按调用栈计数。
+  * 同名的锁计入同一个统计，名字须为字符串常量。
+  *
+  * main_template中，CMainHelper的profile_signo信号启停CPU采样时同时启停锁争用分析，
+  * 停止时在日志目录下生成“程序名.进程号.时间.locks”
+  */
+class CLockProfiler
+{
+public:
+    /** 启用或停用，默认停用 */
+    static void enable(bool enabled);
+    static bool is_enabled() { return __atomic_load_n(&_enabled, __ATOMIC_RELAXED); }
+
+    /** 设置每多少次争用取一次调用栈，为0表示不取，默认为100 */
+    static void set_sample_rate(uint32_t sample_rate);
+
+    /** 清除已有的统计，通常在启用前调用 */
+    static void clear();
+
+    /***
+      * 得到文本格式的结果，按总等待时间从大到小，
+      * 每把锁一行争用次数和等待时间的分布，之后是采样到的调用栈及次数
+      */
+    static std::string to_string();
+
+    /***
+      * 将to_string的结果写入文件
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static void write(const std::string& filename);
+
+public: // 供CLock和CReadWriteLock使用
+    /** 得到名字对应的统计，同名的为同一个，不会被释放 */
+    static CLockContention* get_contention(const char* name);
+
+    /** try_lock失败后、阻塞之前调用，按采样取调用栈，返回开始等待的时间 */
+    static uint64_t begin_wait(CLockContention* contention);
+
+    /** 取得锁之后调用，记录等待的时间 */
+    static void end_wait(CLockContention* contention, uint64_t start_ns);
+
+private:
+    static bool _enabled;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_PROFILER_H
@@ -0,0 +1,164 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_QUEUE_DELAY_H
+#define MOOON_SYS_QUEUE_DELAY_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/utils/array_queue.h"
+#include <string>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 队列的延迟控制策略，见CQueueDelayController
+  */
+struct CQueueDelayPolicy
+{
+    std::string name;               /** 度量名：queue.<name>.sojourn_ns和queue.<name>.shed */
+    uint32_t target_milliseconds;   /** 过载时元素最长的逗留时间 */
+    uint32_t interval_milliseconds; /** 队列持续这么久没有空过即为过载，也是不过载时元素最长的逗留时间 */
+    bool adaptive_lifo;             /** 过载时是否改为后进先出 */
+
+    CQueueDelayPolicy()
+        : target_milliseconds(5), interval_milliseconds(100), adaptive_lifo(false)
+    {
+    }
+};
+
+/***
+  * 被丢弃的元素交给调用者处理（如释放或回复“忙”），在队列的锁外被调用
+  */
+template <typename DataType>
+class IQueueShedder
+{
+public:
+    virtual ~IQueueShedder() {}
+
+    /***
+      * @sojourn_nanoseconds: 元素在队列中逗留的纳秒数
+      */
+    virtual void on_shed(DataType elem, uint64_t sojourn_nanoseconds) = 0;
+};
+
+/***
+  * 队列的延迟控制，供CEventQueue和net::CEpollableQueue使用，在队列的锁内调用，所以非线程安全：
+  * 和队列中的元素一一对应地记录入队时间，出队时将逗留时间计入queue.<name>.sojourn_ns，
+  * 由此看到的是真实的排队延迟，而不只是队列长度。
+  *
+  * 过载的判断采用CoDel的思路：短暂的突发会很快被消化，队列会空，不算过载，
+  * 只有队列持续interval没有空过（即有了“站着的队列”）才算过载。
+  * 过载时逗留超过target的元素被丢弃（不过载时为超过interval），以免服务已经没有意义的陈旧请求，
+  * 若设置了adaptive_lifo，过载时从队尾出队，使新的请求仍能在时限内得到服务，
+  * 队首的陈旧请求则随之被丢弃，不过载时恢复先进先出。
+  */
+class CQueueDelayController
+{
+public:
+    /***
+      * @capacity: 队列的容量，即最多记录的入队时间个数
+      */
+    CQueueDelayController(const CQueueDelayPolicy& policy, uint32_t capacity)
+        : _timestamps(capacity)
+        , _target_nanoseconds(static_cast<uint64_t>(policy.target_milliseconds) * 1000000)
+        , _interval_nanoseconds(static_cast<uint64_t>(policy.interval_milliseconds) * 1000000)
+        , _adaptive_lifo(policy.adaptive_lifo)
+        , _last_empty_nanoseconds(CClock::get_nanoseconds())
+    {
+        _sojourn_histogram = CMetricsRegistry::get_singleton()->get_histogram("queue." + policy.name + ".sojourn_ns");
+        _shed_counter = CMetricsRegistry::get_singleton()->get_counter("queue." + policy.name + ".shed");
+    }
+
+    /** 元素入队后调用 */
+    void on_push(uint64_t now_nanoseconds)
+    {
+        // 之前一直是空的，从现在起才开始积压
+        if (_timestamps.is_empty())
+            _last_empty_nanoseconds = now_nanoseconds;
+        _timestamps.push_back(now_nanoseconds);
+    }
+
+    /** 队列是否有了持续interval的积压 */
+    bool is_overloaded(uint64_t now_nanoseconds) const
+    {
+        return !_timestamps.is_empty() && (now_nanoseconds - _last_empty_nanoseconds > _interval_nanoseconds);
+    }
+
+    /** 本次出队是否应从队尾取 */
+    bool use_lifo(uint64_t now_nanoseconds) const
+    {
+        return _adaptive_lifo && is_overloaded(now_nanoseconds);
+    }
+
+    /** 队首的元素是否已逗留过久，应被丢弃 */
+    bool should_shed_head(uint64_t now_nanoseconds) const
+    {
+        if (_timestamps.is_empty())
+            return false;
+
+        const uint64_t limit = is_overloaded(now_nanoseconds)? _target_nanoseconds: _interval_nanoseconds;
+        return now_nanoseconds - _timestamps.front() > limit;
+    }
+
+    /***
+      * 队首的元素被丢弃后调用
+      * @return: 该元素逗留的纳秒数
+      */
+    uint64_t on_shed_head(uint64_t now_nanoseconds)
+    {
+        const uint64_t sojourn = now_nanoseconds - _timestamps.pop_front();
+        _shed_counter->inc();
+        update_empty(now_nanoseconds);
+        return sojourn;
+    }
+
+    /***
+      * 元素出队后调用
+      * @from_back: 是否从队尾出队
+      * @return: 该元素逗留的纳秒数
+      */
+    uint64_t on_pop(uint64_t now_nanoseconds, bool from_back)
+    {
+        const uint64_t timestamp = from_back? _timestamps.pop_back(): _timestamps.pop_front();
+        const uint64_t sojourn = now_nanoseconds - timestamp;
+        _sojourn_histogram->record(sojourn);
+        update_empty(now_nanoseconds);
+        return sojourn;
+    }
+
+    /** 得到逗留时间的直方图 */
+    CLatencyHistogram* get_sojourn_histogram() const { return _sojourn_histogram; }
+
+private:
+    void update_empty(uint64_t now_nanoseconds)
+    {
+        if (_timestamps.is_empty())
+            _last_empty_nanoseconds = now_nanoseconds;
+    }
+
+private:
+    utils::CArrayQueue<uint64_t> _timestamps; // 和队列中的元素一一对应的入队时间
+    uint64_t _target_nanoseconds;
+    uint64_t _interval_nanoseconds;
+    bool _adaptive_lifo;
+    uint64_t _last_empty_nanoseconds; // 队列最近一次为空的时间
+    CLatencyHistogram* _sojourn_histogram;
+    CCounter* _shed_counter;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_QUEUE_DELAY_H
@@ -0,0 +1,240 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_RATE_LIMITER_H
+#define MOOON_SYS_RATE_LIMITER_H
+#include "mooon/sys/clock.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/spin_lock.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 令牌桶限速器，每秒产生rate个令牌，最多积攒burst个，可用于带宽（一个字节一个令牌）等限制。
+  * 整个状态只有一个原子的64位时间（桶为空的时刻），用CAS更新，不加锁，可被多个线程同时使用。
+  *
+  * 事件循环中使用try_acquire，失败时按wait_nanoseconds用run_after稍后重试；
+  * 阻塞的调用者使用acquire，没有足够令牌时睡眠到令牌足够为止；
+  * reserve先取走令牌（可以透支），返回需要等待的时间，适合先发送再按等待时间暂停。
+  * 一次取的令牌数超过burst时，try_acquire总是失败，只能用reserve或acquire。
+  *
+  * 时间精度为纳秒，每次取令牌的耗时向上取整，rate超过每秒10亿时一次只取一个令牌会偏慢。
+  */
+class CTokenBucket
+{
+public:
+    /***
+      * @rate: 每秒产生的令牌数，必须大于0
+      * @burst: 最多积攒的令牌数，即允许的突发量，为0时取rate（一秒的量）
+      * @metrics_name: 不为空时记录到度量rate_limiter.<metrics_name>.allowed和throttled
+      * @exception: rate为0时抛出utils::CException异常
+      */
+    CTokenBucket(uint64_t rate, uint64_t burst=0, const std::string& metrics_name=std::string());
+
+    /***
+      * 尝试取number个令牌
+      * @wait_nanoseconds: 不为NULL时，失败时为令牌足够还需等待的纳秒数，成功时为0
+      * @return: 令牌足够时取走并返回true，否则不取并返回false
+      */
+    bool try_acquire(uint64_t number=1, uint64_t* wait_nanoseconds=NULL);
+
+    /***
+      * 取走number个令牌，不足时透支
+      * @return: 透支时需要等待的纳秒数，等待之后速率才不超过rate，没有透支时为0
+      */
+    uint64_t reserve(uint64_t number=1);
+
+    /** 阻塞地取number个令牌，令牌不足时睡眠，不能在事件循环线程中调用 */
+    void acquire(uint64_t number=1);
+
+    /** 得到当前可用的令牌数，透支时为0 */
+    uint64_t get_available() const;
+
+    /** 判断桶是否已满，即一直没有使用，可用于回收按键区分的限速器 */
+    bool is_idle(uint64_t now_nanoseconds) const;
+
+    uint64_t get_rate() const { return _rate; }
+    uint64_t get_burst() const { return _burst; }
+
+private:
+    uint64_t get_cost(uint64_t number) const;
+    bool take(uint64_t number, bool overdraw, uint64_t* wait_nanoseconds);
+
+private:
+    uint64_t _rate;
+    uint64_t _burst;
+    uint64_t _burst_nanoseconds; /** 从空到满需要的纳秒数 */
+    uint64_t _empty_time;        /** 桶为空的时刻，之后每过1/rate秒多一个令牌 */
+    CCounter* _allowed_counter;
+    CCounter* _throttled_counter;
+};
+
+/***
+  * GCRA（通用信元速率算法）限速器，允许每period_milliseconds毫秒limit次，
+  * 只保存一个原子的64位“理论到达时间”（TAT），用CAS更新，不加锁。
+  * 效果等同于没有窗口边界突发的滑动窗口：任意长为period的时间段内，最多通过limit次，
+  * 空闲之后最多连续通过burst次。和CTokenBucket不同，被拒绝的请求不占用配额，不会透支，
+  * 适合按客户端的请求配额（可配合CKeyedRateLimiter）和数据库写入限流。
+  */
+class CGcraLimiter
+{
+public:
+    /***
+      * @limit: 每个周期允许的次数，必须大于0
+      * @period_milliseconds: 周期毫秒数，必须大于0
+      * @burst: 允许的最大突发次数，为0时取limit
+      * @metrics_name: 不为空时记录到度量rate_limiter.<metrics_name>.allowed和throttled
+      * @exception: 参数为0时抛出utils::CException异常
+      */
+    CGcraLimiter(uint64_t limit, uint32_t period_milliseconds=1000, uint64_t burst=0, const std::string& metrics_name=std::string());
+
+    /***
+      * 尝试通过number次
+      * @wait_nanoseconds: 不为NULL时，失败时为可以通过还需等待的纳秒数，成功时为0
+      * @return: 允许时返回true并计入，否则返回false且不计入
+      */
+    bool try_acquire(uint64_t number=1, uint64_t* wait_nanoseconds=NULL);
+
+    /***
+      * 阻塞地通过number次，不能在事件循环线程中调用
+      * @exception: number超过burst时抛出utils::CException异常
+      */
+    void acquire(uint64_t number=1);
+
+    /** 得到当前还可以立即通过的次数 */
+    uint64_t get_remaining() const;
+
+    /** 判断是否已恢复到满额，可用于回收按键区分的限速器 */
+    bool is_idle(uint64_t now_nanoseconds) const;
+
+private:
+    bool take(uint64_t number, uint64_t* wait_nanoseconds);
+
+private:
+    uint64_t _emission_interval; /** 每次的间隔纳秒数，即period/limit */
+    uint64_t _tolerance;         /** 容许提前的纳秒数，即burst*_emission_interval */
+    uint64_t _tat;               /** 理论到达时间 */
+    CCounter* _allowed_counter;
+    CCounter* _throttled_counter;
+};
+
+/***
+  * 按键区分的限速器，每个键（如客户端IP或用户ID）一个独立的Limiter，参数都相同。
+  * 键按哈希分成多个分片，每个分片一把自适应锁，不同分片的键互不竞争，没有全局锁。
+  * 键在第一次使用时从原型复制创建，调用expire回收已恢复满额的键，以限制内存。
+  *
+  * @Limiter: CTokenBucket或CGcraLimiter
+  */
+template <class Limiter>
+class CKeyedRateLimiter
+{
+public:
+    /***
+      * @prototype: 每个键的限速器的原型，之后不要再使用它
+      * @shard_number: 分片数，取整为2的幂
+      */
+    CKeyedRateLimiter(const Limiter& prototype, uint32_t shard_number=16)
+        : _prototype(prototype)
+    {
+        uint32_t number = 1;
+        while (number < shard_number)
+            number <<= 1;
+        _shards.resize(number);
+        for (uint32_t i=0; i<number; ++i)
+            _shards[i] = new Shard;
+    }
+
+    ~CKeyedRateLimiter()
+    {
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+            delete _shards[i];
+    }
+
+    /** 同Limiter::try_acquire，键不存在时先创建 */
+    bool try_acquire(const std::string& key, uint64_t number=1, uint64_t* wait_nanoseconds=NULL)
+    {
+        Shard* shard = _shards[std::hash<std::string>()(key) & (_shards.size() - 1)];
+        LockHelper<CAdaptiveLock> lock_helper(shard->lock);
+
+        typename limiter_table_t::iterator iter = shard->limiters.find(key);
+        if (iter == shard->limiters.end())
+            iter = shard->limiters.emplace(key, _prototype).first;
+        return iter->second.try_acquire(number, wait_nanoseconds);
+    }
+
+    /***
+      * 删除已恢复满额的键，这些键再次使用时重新创建，效果和未删除相同
+      * @return: 删除的键数
+      */
+    size_t expire()
+    {
+        const uint64_t now = CClock::get_nanoseconds();
+        size_t number = 0;
+
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            Shard* shard = _shards[i];
+            LockHelper<CAdaptiveLock> lock_helper(shard->lock);
+            for (typename limiter_table_t::iterator iter=shard->limiters.begin(); iter!=shard->limiters.end();)
+            {
+                if (!iter->second.is_idle(now))
+                {
+                    ++iter;
+                }
+                else
+                {
+                    iter = shard->limiters.erase(iter);
+                    ++number;
+                }
+            }
+        }
+
+        return number;
+    }
+
+    /** 得到键的个数 */
+    size_t size() const
+    {
+        size_t number = 0;
+        for (typename std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+        {
+            LockHelper<CAdaptiveLock> lock_helper(_shards[i]->lock);
+            number += _shards[i]->limiters.size();
+        }
+        return number;
+    }
+
+private:
+    typedef std::unordered_map<std::string, Limiter> limiter_table_t;
+
+    struct Shard
+    {
+        CAdaptiveLock lock;
+        limiter_table_t limiters;
+    };
+
+private:
+    const Limiter _prototype;
+    std::vector<Shard*> _shards;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_RATE_LIMITER_H
@@ -1,7 +1,10 @@
 #ifndef MOOON_SYS_READ_WRITE_LOCK
 #define MOOON_SYS_READ_WRITE_LOCK
+#include "mooon/sys/lock.h"
+#include "mooon/sys/spin_lock.h"
 #include "mooon/sys/utils.h"
 #include <pthread.h>
+#include <string.h>
 SYS_NAMESPACE_BEGIN
 
 // 命令行工具debuginfo-install用于安装debug信息，示例（为glibc安装debug信息，以方便跟踪调试）：debuginfo-install glibc
@@ -23,6 +26,10 @@ public:
       */
 	void unlock();
 
+    /** 同unlock，和CDistributedReadWriteLock等接口一致，供ReadLockHelper和WriteLockHelper使用 */
+    void unlock_read() { unlock(); }
+    void unlock_write() { unlock(); }
+
     /***
       * 获取读锁，如果写锁正被持有则一直等待直到可获取到读锁
       * 注意同一个线程加了同一个对象的读锁后再加写锁会死锁！！！
@@ -68,53 +75,255 @@ public:
       * @exception: 出错抛出CSyscallException异常
       */
 	bool timed_lock_write(uint32_t millisecond);
-	
+
+    /***
+      * 设置锁的名字，读锁和写锁的争用计入同一个统计，同CLock::set_contention_name
+      */
+    void set_contention_name(const char* name) { _contention_name = name; }
+
+private:
+    CLockContention* get_contention();
+
 private:
 	pthread_rwlock_t _rwlock;
+    const char* _contention_name;
+    CLockContention* _contention; // 第一次争用时取得
+};
+
+/***
+  * 分布式读写锁，写优先
+  * 读者计数分散在多个独占缓存行的槽中，每个线程固定使用其中一个槽，
+  * 因此只读的场景下各CPU之间没有缓存行争用，读锁的开销为一次原子加和一次原子减，
+  * 代价是写锁需要检查所有的槽，适用于读远多于写的场景。
+  *
+  * 写优先：写者等待期间，新的读者会等待写者完成，写者不会被持续的读者饿死，
+  * 因此同一线程不能递归加读锁（中间若有写者在等待，会死锁），
+  * 加了读锁后再加写锁同样会死锁。不支持超时加锁。
+  */
+class CDistributedReadWriteLock
+{
+public:
+    /***
+      * @slot_number: 读者计数槽个数，会向上取为2的幂，为0时取CPU个数
+      */
+    CDistributedReadWriteLock(uint16_t slot_number=0);
+    ~CDistributedReadWriteLock() throw ();
+
+    /** 获取读锁，如果写锁正被持有或有写者在等待，则一直等待直到可获取到读锁 */
+    void lock_read();
+
+    /** 释放读锁 */
+    void unlock_read();
+
+    /** 获取写锁，等待所有已有的读者释放读锁 */
+    void lock_write();
+
+    /** 释放写锁 */
+    void unlock_write();
+
+    /***
+      * 尝试去获取读锁，如果写锁正被持有或有写者在等待则立即返回
+      * @return: 如果成功获取了读锁，则返回true，否则返回false
+      */
+    bool try_lock_read();
+
+    /***
+      * 尝试去获取写锁，如果写锁正被持有或还有读者则立即返回
+      * @return: 如果成功获取了写锁，则返回true，否则返回false
+      */
+    bool try_lock_write();
+
+    /** 得到读者计数槽个数 */
+    uint16_t get_slot_number() const { return _slot_mask + 1; }
+
+private:
+    struct Slot
+    {
+        volatile int32_t readers;
+        char pad[CACHE_LINE_SIZE - sizeof(int32_t)]; // 每个槽独占一个缓存行
+    };
+
+private:
+    Slot* get_slot();
+    bool has_reader() const;
+    void wait_writer();
+    void wake_readers();
+
+private:
+    Slot* _slots;
+    uint16_t _slot_mask;
+    int _writer; /** 1表示有写者持有或在等待写锁，也用作futex */
+    int _waiter_number; /** 等待写者完成的读者数 */
+    CLock _writer_lock; /** 写者之间互斥 */
+};
+
+/***
+  * 顺序锁，适用于小的、读多写少的数据，如配置和统计
+  * 读者不加锁也不写共享内存，读之前和之后各取一次序号，序号为奇数或前后不同时重读，
+  * 写者之间互斥，写时序号加一变为奇数，写完再加一变为偶数。
+  * 写者可使用WriteLockHelper，读者使用read_begin和read_retry，或直接使用CSeqData。
+  *
+  * 使用示例：
+  * uint32_t seq;
+  * do {
+  *     seq = seq_lock.read_begin();
+  *     copy = data;
+  * } while (seq_lock.read_retry(seq));
+  */
+class CSeqLock
+{
+public:
+    CSeqLock();
+
+    /** 开始读，等待正在进行的写完成，返回当前序号 */
+    uint32_t read_begin() const
+    {
+        uint32_t seq;
+        while ((seq = __atomic_load_n(&_seq, __ATOMIC_ACQUIRE)) & 1)
+            SPIN_LOCK_PAUSE();
+        return seq;
+    }
+
+    /***
+      * 结束读
+      * @seq: read_begin返回的序号
+      * @return: 如果读的过程中有写，返回true，需要重读
+      */
+    bool read_retry(uint32_t seq) const
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&_seq, __ATOMIC_RELAXED) != seq;
+    }
+
+    /** 开始写 */
+    void lock_write()
+    {
+        _writer_lock.lock();
+        __atomic_store_n(&_seq, _seq+1, __ATOMIC_RELAXED); // 写者互斥，不需原子加
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    /** 结束写 */
+    void unlock_write()
+    {
+        __atomic_store_n(&_seq, _seq+1, __ATOMIC_RELEASE);
+        _writer_lock.unlock();
+    }
+
+private:
+    uint32_t _seq;
+    CLock _writer_lock;
+};
+
+/***
+  * 由顺序锁保护的数据，DataType须可按字节复制（不含指针所有权等），
+  * 读时复制一份，因此适用于较小的数据
+  */
+template <typename DataType>
+class CSeqData
+{
+public:
+    CSeqData()
+    {
+    }
+
+    CSeqData(const DataType& data)
+        :_data(data)
+    {
+    }
+
+    /** 读取数据的一致性副本 */
+    DataType get() const
+    {
+        DataType data;
+        uint32_t seq;
+
+        do
+        {
+            seq = _seq_lock.read_begin();
+            memcpy(static_cast<void*>(&data), static_cast<const void*>(&_data), sizeof(DataType));
+        } while (_seq_lock.read_retry(seq));
+
+        return data;
+    }
+
+    /** 更新数据 */
+    void set(const DataType& data)
+    {
+        _seq_lock.lock_write();
+        memcpy(static_cast<void*>(&_data), static_cast<const void*>(&data), sizeof(DataType));
+        _seq_lock.unlock_write();
+    }
+
+private:
+    mutable CSeqLock _seq_lock;
+    DataType _data;
 };
 
 /***
   * 读锁帮助类，用于自动释放读锁
+  * 适用于CReadWriteLock和CDistributedReadWriteLock等有lock_read和unlock_read的锁
   */
 class ReadLockHelper
 {
 public:
-    ReadLockHelper(CReadWriteLock& lock)
-      :_read_lock(lock)
+    template <class ReadWriteLockClass>
+    ReadLockHelper(ReadWriteLockClass& lock)
+      :_read_lock(&lock)
+      ,_unlock(&unlock_read<ReadWriteLockClass>)
     {
-        _read_lock.lock_read();
+        lock.lock_read();
     }    
     
     /** 析构函数，会自动调用unlock解锁 */
     ~ReadLockHelper()
     {
-        _read_lock.unlock();
+        (*_unlock)(_read_lock);
+    }
+
+private:
+    template <class ReadWriteLockClass>
+    static void unlock_read(void* lock)
+    {
+        static_cast<ReadWriteLockClass*>(lock)->unlock_read();
     }
     
 private:
-    CReadWriteLock& _read_lock;
+    void* _read_lock;
+    void (*_unlock)(void*);
 };
 
 /***
   * 读锁帮助类，用于自动释放写锁
+  * 适用于CReadWriteLock、CDistributedReadWriteLock和CSeqLock等有lock_write和unlock_write的锁
   */
 class WriteLockHelper
 {
 public:
-    WriteLockHelper(CReadWriteLock& lock)
-      :_write_lock(lock)
+    template <class ReadWriteLockClass>
+    WriteLockHelper(ReadWriteLockClass& lock)
+      :_write_lock(&lock)
+      ,_unlock(&unlock_write<ReadWriteLockClass>)
     {
-        _write_lock.lock_write();
+        lock.lock_write();
     }
     
     /** 析构函数，会自动调用unlock解锁 */
     ~WriteLockHelper()
     {
-        _write_lock.unlock();
+        (*_unlock)(_write_lock);
+    }
+
+private:
+    template <class ReadWriteLockClass>
+    static void unlock_write(void* lock)
+    {
+        static_cast<ReadWriteLockClass*>(lock)->unlock_write();
     }
     
 private:
-    CReadWriteLock& _write_lock;
+    void* _write_lock;
+    void (*_unlock)(void*);
 };
 
 SYS_NAMESPACE_END
@@ -0,0 +1,275 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_RECLAIMER_H
+#define MOOON_SYS_RECLAIMER_H
+#include "mooon/sys/config.h"
+#include <pthread.h>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 无锁数据结构的延迟销毁（safe memory reclamation）：
+  * 写者将节点从结构中摘下后不能立即delete，因为读者可能还在访问它，
+  * 而是retire给回收器，等确认没有读者还能访问时再销毁。
+  *
+  * 提供两种回收器：
+  * 1) CEpochReclaimer：基于纪元（EBR），读者只需进出临界区，开销最小，
+  *    但一个读者长期不离开临界区时，所有被retire的对象都不能回收
+  * 2) CHazardPointers：基于风险指针，读者逐个登记正在访问的指针，开销稍大，
+  *    但未回收的对象个数有上限，适合读者可能阻塞的场合
+  *
+  * 每个线程第一次使用时自动登记一个线程记录（以pthread_key关联），线程退出时归还，
+  * 记录不释放，由之后的线程复用。被retire但还未回收的对象留在记录中，由复用者或回收器析构时销毁。
+  * 回收器应是全局或长生命周期的对象，须在所有使用它的线程退出后才销毁。
+  */
+
+/** 销毁被retire的对象的函数 */
+typedef void (*reclaim_deleter_t)(void* object);
+
+/** 以delete销毁，用于retire的模板版本 */
+template <typename T>
+void reclaim_delete(void* object)
+{
+    delete static_cast<T*>(object);
+}
+
+/** 被retire还未回收的对象 */
+struct retired_object_t
+{
+    void* object;
+    reclaim_deleter_t deleter;
+    uint64_t epoch; // retire时的纪元，CHazardPointers不使用
+};
+
+/***
+  * 基于纪元的回收器（EBR），也支持静止状态（QSBR）用法：
+  *
+  * 1) 普通线程：读之前enter（或用CEpochGuard），读完leave，临界区内取得的指针在leave之前有效，
+  *    临界区可以嵌套，进出只有一次线程私有的写，入口处一次全屏障
+  * 2) 事件循环和线程池线程（RCU风格）：启动时enter一次，之后每轮循环在不持有任何指针的地方调用quiescent，
+  *    读时不再进出临界区，进入可能长期阻塞的等待（如epoll_wait）前应leave，醒来后再enter
+  *
+  * 全局纪元只有在所有处于临界区的线程都已观察到当前纪元后才能推进，
+  * 纪元e时retire的对象在全局纪元推进到e+2后销毁，此时不可能还有读者持有它。
+  * 回收在retire（每个线程积累到一定个数时）和quiescent中进行，只回收本线程retire的对象。
+  *
+  * 使用示例：
+  * static CEpochReclaimer reclaimer;
+  * { CEpochGuard guard(&reclaimer); Node* node = __atomic_load_n(&head, __ATOMIC_ACQUIRE); ... } // 读者
+  * Node* old = __atomic_exchange_n(&head, new_node, __ATOMIC_ACQ_REL); reclaimer.retire(old); // 写者
+  */
+class CEpochReclaimer
+{
+public:
+    /***
+      * @reclaim_threshold: 一个线程retire的对象积累到多少个时尝试回收
+      * @exception: 创建pthread_key失败时抛出CSyscallException异常
+      */
+    CEpochReclaimer(uint32_t reclaim_threshold=64);
+    ~CEpochReclaimer();
+
+    /** 进入临界区，可嵌套 */
+    void enter();
+
+    /** 离开临界区，须和enter配对 */
+    void leave();
+
+    /***
+      * 宣告本线程处于静止状态（不持有任何受保护的指针），并尝试推进纪元和回收，
+      * 在临界区中调用时相当于leave后立即enter，但不改变嵌套层数
+      */
+    void quiescent();
+
+    /** 延迟销毁一个已从数据结构中摘下的对象，可在临界区内或外调用 */
+    void retire(void* object, reclaim_deleter_t deleter);
+
+    template <typename T>
+    void retire(T* object)
+    {
+        retire(object, reclaim_delete<T>);
+    }
+
+    /***
+      * 尝试推进纪元并回收本线程可回收的对象
+      * @return: 本次销毁的对象个数
+      */
+    uint32_t try_reclaim();
+
+    /** 当前的全局纪元 */
+    uint64_t get_epoch() const { return __atomic_load_n(&_global_epoch, __ATOMIC_ACQUIRE); }
+
+    /** 已retire但还未销毁的对象个数，是近似值 */
+    uint64_t get_pending_number() const { return __atomic_load_n(&_pending_number, __ATOMIC_RELAXED); }
+
+private:
+    struct Record;
+
+    Record* get_record();
+    bool try_advance(uint64_t epoch);
+    uint32_t reclaim(Record* record);
+    static void on_thread_exit(void* param);
+
+private:
+    uint64_t _global_epoch;
+    char _pad[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    Record* _records; // 所有线程记录的链表，只增不减
+    uint64_t _pending_number;
+    uint32_t _reclaim_threshold;
+    pthread_key_t _record_key;
+};
+
+/** 以构造和析构进出CEpochReclaimer的临界区 */
+class CEpochGuard
+{
+public:
+    CEpochGuard(CEpochReclaimer* reclaimer)
+        : _reclaimer(reclaimer)
+    {
+        _reclaimer->enter();
+    }
+
+    ~CEpochGuard()
+    {
+        _reclaimer->leave();
+    }
+
+private:
+    CEpochReclaimer* _reclaimer;
+};
+
+/***
+  * 风险指针（hazard pointers）回收器，
+  * 每个线程有slot_number个槽位，读者以protect在槽位中登记要访问的指针，用完clear，
+  * retire的对象积累到一定个数时扫描所有线程的槽位，销毁不在任何槽位中的。
+  *
+  * 使用示例（读栈顶）：
+  * Node* top = hazard_pointers.protect(0, &stack_top);
+  * if (top != NULL) value = top->value;
+  * hazard_pointers.clear(0);
+  */
+class CHazardPointers
+{
+public:
+    /***
+      * @slot_number: 每个线程可同时登记的指针个数
+      * @exception: 创建pthread_key失败时抛出CSyscallException异常
+      */
+    CHazardPointers(uint32_t slot_number=4);
+    ~CHazardPointers();
+
+    /***
+      * 读取*source并登记到槽位slot中，返回时可以安全访问，直到clear或再次protect该槽位
+      * @source: 被其它线程修改的共享指针
+      */
+    template <typename T>
+    T* protect(uint32_t slot, T* const* source)
+    {
+        void** hazard = get_slot(slot);
+        T* pointer = __atomic_load_n(source, __ATOMIC_ACQUIRE);
+        for (;;)
+        {
+            // 登记后再读一次，没变说明登记时对象还未被摘下，之后retire的扫描一定能看到登记
+            __atomic_store_n(hazard, static_cast<void*>(pointer), __ATOMIC_SEQ_CST);
+            T* current = __atomic_load_n(source, __ATOMIC_ACQUIRE);
+            if (current == pointer)
+                return pointer;
+            pointer = current;
+        }
+    }
+
+    /** 清除槽位slot的登记 */
+    void clear(uint32_t slot);
+
+    /** 延迟销毁一个已从数据结构中摘下的对象 */
+    void retire(void* object, reclaim_deleter_t deleter);
+
+    template <typename T>
+    void retire(T* object)
+    {
+        retire(object, reclaim_delete<T>);
+    }
+
+    /***
+      * 扫描并回收本线程retire的对象
+      * @return: 本次销毁的对象个数
+      */
+    uint32_t scan();
+
+    uint32_t get_slot_number() const { return _slot_number; }
+
+private:
+    struct Record;
+
+    Record* get_record();
+    void** get_slot(uint32_t slot);
+    uint32_t reclaim(Record* record);
+    static void on_thread_exit(void* param);
+
+private:
+    const uint32_t _slot_number;
+    Record* _records;
+    uint32_t _record_number;
+    pthread_key_t _record_key;
+};
+
+/***
+  * RCU风格的指针，用于读多写少的表（如配置、路由表）：
+  * 读者在CEpochReclaimer的临界区内get，不加锁；
+  * 写者用update整体替换（先复制再修改再替换），旧对象retire，
+  * 多个写者之间需要外部加锁，或在同一个线程中更新。
+  */
+template <typename T>
+class CRcuPointer
+{
+public:
+    CRcuPointer(CEpochReclaimer* reclaimer, T* pointer=NULL)
+        : _reclaimer(reclaimer), _pointer(pointer)
+    {
+    }
+
+    ~CRcuPointer()
+    {
+        delete _pointer;
+    }
+
+    /** 须在临界区内调用，返回的指针在离开临界区前有效 */
+    const T* get() const
+    {
+        return __atomic_load_n(&_pointer, __ATOMIC_ACQUIRE);
+    }
+
+    /** 替换为pointer，旧对象在读者都离开后销毁 */
+    void update(T* pointer)
+    {
+        T* old_pointer = __atomic_exchange_n(&_pointer, pointer, __ATOMIC_ACQ_REL);
+        if (old_pointer != NULL)
+            _reclaimer->retire(old_pointer);
+    }
+
+private:
+    CRcuPointer(const CRcuPointer&);
+    CRcuPointer& operator =(const CRcuPointer&);
+
+private:
+    CEpochReclaimer* _reclaimer;
+    T* _pointer;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_RECLAIMER_H
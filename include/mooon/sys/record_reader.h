@@ -0,0 +1,155 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_RECORD_READER_H
+#define MOOON_SYS_RECORD_READER_H
+#include "mooon/sys/mmap.h"
+#include <string>
+#include <string_view>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * CRecordReader::parallel_read的记录处理器，
+  * 不同块在不同的线程中被并发调用，同一块的记录按顺序在同一个线程中调用
+  */
+class CRecordHandler
+{
+public:
+    virtual ~CRecordHandler() {}
+
+    /***
+      * @chunk: 块号，从0开始，块号小的块中的记录在文件中也靠前
+      * @record: 不含行尾的记录
+      * @return: 返回false时该块不再继续读取，其它块不受影响
+      */
+    virtual bool handle(int chunk, std::string_view record) = 0;
+};
+
+/***
+  * 文本文件（日志、CSV和TSV等）的记录读取器，用于代替ifstream和fgets逐行读取大文件：
+  * 文件被映射到内存（或以大块read管道），以向量化的memchr查找换行符，
+  * 记录和字段都是指向映射内存的视图，不复制数据，
+  * 大文件还可以用parallel_read按记录边界切块，多个线程并行处理。
+  *
+  * 记录以'\n'结束，结尾的'\r'被去掉，最后一条记录可以没有换行符。
+  * 指定了引号时按RFC 4180处理：引号中的分隔符和换行符不起作用，引号中以连续两个引号表示一个引号。
+  * 非线程安全。
+  *
+  * 使用示例：
+  * mooon::sys::CRecordReader reader('\t');
+  * std::vector<std::string_view> fields;
+  * reader.open("/data/access.log");
+  * while (reader.next(&fields)) { ... }
+  */
+class CRecordReader
+{
+public:
+    /***
+      * @delimiter: 字段分隔符，只在切分字段时使用
+      * @quote: 引号，为'\0'时不处理引号，即记录就是行
+      */
+    CRecordReader(char delimiter=',', char quote='\0');
+    ~CRecordReader();
+
+    /***
+      * 以只读方式映射整个文件，之前打开的先被关闭
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void open(const std::string& filename);
+
+    /***
+      * 从fd中读取，用于不能映射的管道和标准输入等，每次read最多buffer_size字节，
+      * 不完整的记录留到下一次read，缓冲区放不下一条记录时自动扩大，调用者负责关闭fd
+      */
+    void open(int fd, size_t buffer_size=SIZE_1M);
+
+    /** 读取内存中的数据，不复制，调用者须保证读取期间数据有效 */
+    void attach(const char* data, size_t size);
+
+    /***
+      * 关闭，释放映射和缓冲区，之前得到的视图变为无效
+      * @exception: munmap出错时抛出CSyscallException异常
+      */
+    void close();
+
+    /***
+      * 读取下一条记录，open(filename)和attach时视图在close前都有效，
+      * open(fd)时只在下一次读取前有效
+      * @return: 没有更多的记录时返回false
+      * @exception: read出错时抛出CSyscallException异常
+      */
+    bool next(std::string_view* record);
+
+    /** 读取下一条记录并切分成字段，同split */
+    bool next(std::vector<std::string_view>* fields);
+
+    /** 已读取（包括parallel_read处理）的记录数 */
+    uint64_t get_record_number() const { return _record_number; }
+
+    /***
+      * 将余下的所有记录切成多块，多个线程并行处理，块0在调用者线程中处理，
+      * 各块先在等分处切开，再各自调整到其后的第一个记录边界（有引号时先并行统计各块中的引号个数，
+      * 以确定切开处是否在引号中），之后next返回false。
+      * 只能用于open(filename)和attach。
+      * @thread_number: 线程数，为0时每64MB一个线程，不超过CPU个数
+      * @return: 处理的记录数
+      * @exception: 用于open(fd)时抛出CException异常
+      */
+    uint64_t parallel_read(CRecordHandler* handler, int thread_number=0);
+
+    /***
+      * 切分一条记录，fields先被清空，空记录没有字段，分隔符在结尾时最后有一个空字段，
+      * 带引号的字段去掉首尾的引号，其中连续两个引号不被还原（需要时调用unquote）
+      * @return: 字段个数
+      */
+    static int split(std::string_view record, char delimiter, char quote, std::vector<std::string_view>* fields);
+
+    /** 将字段中连续两个引号还原为一个 */
+    static std::string unquote(std::string_view field, char quote='"');
+
+public:
+    struct Chunk;
+
+private:
+    CRecordReader(const CRecordReader&);
+    CRecordReader& operator =(const CRecordReader&);
+
+    // 从_offset开始在[_data, _data+_size)中查找一条完整的记录，找不到时返回false
+    bool find_record(size_t* record_end, size_t* next_offset) const;
+
+    // 读入更多的数据，返回false表示fd已读完
+    bool fill();
+
+private:
+    const char _delimiter;
+    const char _quote;
+    const char* _data;
+    size_t _size;
+    size_t _offset;
+    uint64_t _record_number;
+    mmap_t* _mmap;
+
+    // open(fd)时
+    int _fd;
+    bool _eof;
+    std::vector<char> _buffer;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_RECORD_READER_H
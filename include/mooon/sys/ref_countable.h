@@ -23,53 +23,341 @@
 SYS_NAMESPACE_BEGIN
 
 /***
-  * 引用计数基类
+  * 引用计数的策略，作为CRefCountableT的模板参数，须提供：
+  * attach(object, deleter)：构造时关联所属的对象，延迟销毁时使用
+  * inc()：增一
+  * dec()：减一，返回true表示计数变成0，由调用者销毁对象
+  * get()：当前的计数值
+  */
+
+/** 原子的引用计数，可在任意线程增减，是CRefCountable的策略 */
+class CAtomicRefCount
+{
+public:
+    CAtomicRefCount()
+    {
+        atomic_set(&_refcount, 0);
+    }
+
+    void attach(void* object, void (*deleter)(void*))
+    {
+    }
+
+    void inc()
+    {
+        atomic_inc(&_refcount);
+    }
+
+    bool dec()
+    {
+        return atomic_dec_and_test(&_refcount);
+    }
+
+    int get() const
+    {
+        return atomic_read(&_refcount);
+    }
+
+private:
+    atomic_t _refcount;
+};
+
+/***
+  * 非原子的引用计数，增减只是普通的加减，
+  * 只能用于从不跨线程传递的对象（如只在一个事件循环内使用的连接），否则计数会被破坏
+  */
+class CNonAtomicRefCount
+{
+public:
+    CNonAtomicRefCount()
+        : _refcount(0)
+    {
+    }
+
+    void attach(void* object, void (*deleter)(void*))
+    {
+    }
+
+    void inc()
+    {
+        ++_refcount;
+    }
+
+    bool dec()
+    {
+        return 0 == --_refcount;
+    }
+
+    int get() const
+    {
+        return _refcount;
+    }
+
+private:
+    int _refcount;
+};
+
+/***
+  * 偏向拥有线程的引用计数（biased reference counting），
+  * 构造对象的线程为拥有线程，它的增减只修改线程私有的偏向计数，是普通的加减，
+  * 其它线程的增减以原子操作修改共享计数，对象的引用计数是两者之和。
+  *
+  * 1) 拥有线程的偏向计数减到0时，将偏向计数合并到共享计数，之后对象退化为原子计数
+  * 2) 共享计数未合并时被其它线程减到不大于0，说明对象可能已没有引用，
+  *    这时将对象交给拥有线程，由拥有线程在merge_pending中合并，计数为0时销毁，
+  *    因此这种情况下对象的销毁被推迟到拥有线程下次调用merge_pending（事件循环每轮都会调用），
+  *    拥有线程退出时也会处理，之后交来的对象由交出者直接合并
+  *
+  * 适合绝大多数增减发生在拥有线程、偶尔跨线程的对象，
+  * get_refcount在其它线程中调用时是近似值。
+  */
+class CBiasedRefCount
+{
+public:
+    CBiasedRefCount();
+
+    void attach(void* object, void (*deleter)(void*))
+    {
+        _object = object;
+        _deleter = deleter;
+    }
+
+    void inc()
+    {
+        if (is_owner() && !_merged)
+            ++_biased;
+        else
+            __atomic_add_fetch(&_shared, COUNT_ONE, __ATOMIC_RELAXED);
+    }
+
+    bool dec()
+    {
+        if (is_owner() && !_merged)
+        {
+            if (--_biased > 0)
+                return false;
+            return merge();
+        }
+
+        return dec_shared();
+    }
+
+    int get() const;
+
+    /** 当前线程是否为拥有线程 */
+    bool is_owner() const
+    {
+        return _queue == _thread_queue;
+    }
+
+    /***
+      * 处理其它线程交给本线程（拥有线程）的对象，计数为0的被销毁，
+      * 应在不持有这些对象的安全点调用，如事件循环的每一轮
+      * @return: 被销毁的对象个数
+      */
+    static uint32_t merge_pending();
+
+public:
+    struct Queue;
+
+private:
+    bool merge();
+    bool dec_shared();
+    bool reconcile();
+    static Queue* get_queue();
+
+private:
+    // 共享计数的低两位为标志，计数值从第2位开始
+    static const int64_t MERGED = 1;    // 偏向计数已合并，之后都是原子操作
+    static const int64_t QUEUED = 2;    // 已交给拥有线程，只能由拥有线程（或交出者）销毁
+    static const int64_t COUNT_ONE = 4;
+
+private:
+    Queue* _queue;    // 拥有线程的待合并队列，也用来识别拥有线程
+    int _biased;      // 只由拥有线程访问
+    bool _merged;     // 只由拥有线程访问
+    int64_t _shared;
+    void* _object;
+    void (*_deleter)(void*);
+    static __thread Queue* _thread_queue;
+};
+
+/***
+  * 引用计数基类，RefCountPolicy为计数的策略，
   * 不应当直接使用此类，而应当总是从它继承
   */
-class CRefCountable
+template <class RefCountPolicy>
+class CRefCountableT
 {
 public:
-	CRefCountable()
-	{
-		atomic_set(&_refcount, 0);
-	}
+    CRefCountableT()
+    {
+        _refcount.attach(this, destroy);
+    }
 
     /** 虚拟析构函数是必须的，否则无法删除子类对象 */
-	virtual ~CRefCountable()
-	{
-	}
+    virtual ~CRefCountableT()
+    {
+    }
 
     /** 得到引用计数值 */
     int get_refcount() const
     {
-        return atomic_read(&_refcount);
+        return _refcount.get();
     }
 
     /** 对引用计数值增一 */
-	void inc_refcount()
-	{
-		atomic_inc(&_refcount);
-	}
+    void inc_refcount()
+    {
+        _refcount.inc();
+    }
 
     /***
       * 对引用计数值减一
       * 如果引用计数值减一后，引用计数值变成0，则对象自删除
       * @return: 如果对象自删除，则返回true，否则返回false
       */
-	bool dec_refcount()
-	{
-		volatile bool deleted = false;
-		if (atomic_dec_and_test(&_refcount))
-		{
-			deleted = true;
-			delete this;
-		}
-
-		return deleted;
-	}
+    bool dec_refcount()
+    {
+        if (_refcount.dec())
+        {
+            delete this;
+            return true;
+        }
+
+        return false;
+    }
+
+private:
+    static void destroy(void* object)
+    {
+        delete static_cast<CRefCountableT*>(object);
+    }
+
+private:
+    RefCountPolicy _refcount;
+};
+
+/** 原子引用计数的基类，可在任意线程增减 */
+typedef CRefCountableT<CAtomicRefCount> CRefCountable;
+
+/** 非原子引用计数的基类，对象不能跨线程 */
+typedef CRefCountableT<CNonAtomicRefCount> CLocalRefCountable;
+
+/** 偏向构造线程的引用计数的基类 */
+typedef CRefCountableT<CBiasedRefCount> CBiasedRefCountable;
+
+/***
+  * 侵入式的引用计数智能指针，T须有inc_refcount和dec_refcount，
+  * 复制时增加引用计数，析构或重置时减少，移动时只转移指针，不增减计数，
+  * 因此传递引用时应尽量用移动（或swap）避免多余的一对增减。
+  */
+template <class T>
+class CRefPtr
+{
+public:
+    CRefPtr()
+        : _pointer(NULL)
+    {
+    }
+
+    /** 增加pointer的引用计数 */
+    CRefPtr(T* pointer)
+        : _pointer(pointer)
+    {
+        if (_pointer != NULL)
+            _pointer->inc_refcount();
+    }
+
+    CRefPtr(const CRefPtr& other)
+        : _pointer(other._pointer)
+    {
+        if (_pointer != NULL)
+            _pointer->inc_refcount();
+    }
+
+#if __cplusplus >= 201103L
+    CRefPtr(CRefPtr&& other)
+        : _pointer(other._pointer)
+    {
+        other._pointer = NULL;
+    }
+
+    CRefPtr& operator =(CRefPtr&& other)
+    {
+        if (this != &other)
+        {
+            T* pointer = _pointer;
+            _pointer = other._pointer;
+            other._pointer = NULL;
+            if (pointer != NULL)
+                pointer->dec_refcount();
+        }
+
+        return *this;
+    }
+#endif // __cplusplus >= 201103L
+
+    ~CRefPtr()
+    {
+        if (_pointer != NULL)
+            _pointer->dec_refcount();
+    }
+
+    CRefPtr& operator =(const CRefPtr& other)
+    {
+        reset(other._pointer);
+        return *this;
+    }
+
+    CRefPtr& operator =(T* pointer)
+    {
+        reset(pointer);
+        return *this;
+    }
+
+    /** 指向pointer（增加它的引用计数），并减少原来对象的引用计数 */
+    void reset(T* pointer=NULL)
+    {
+        if (pointer != NULL)
+            pointer->inc_refcount();
+        T* old_pointer = _pointer;
+        _pointer = pointer;
+        if (old_pointer != NULL)
+            old_pointer->dec_refcount();
+    }
+
+    /** 接管pointer已有的一个引用，不增加引用计数 */
+    void adopt(T* pointer)
+    {
+        T* old_pointer = _pointer;
+        _pointer = pointer;
+        if (old_pointer != NULL)
+            old_pointer->dec_refcount();
+    }
+
+    /** 交出持有的引用，不减少引用计数，由调用者负责减少 */
+    T* release()
+    {
+        T* pointer = _pointer;
+        _pointer = NULL;
+        return pointer;
+    }
+
+    void swap(CRefPtr& other)
+    {
+        T* pointer = _pointer;
+        _pointer = other._pointer;
+        other._pointer = pointer;
+    }
+
+    T* get() const { return _pointer; }
+    T* operator ->() const { return _pointer; }
+    T& operator *() const { return *_pointer; }
+    operator bool() const { return _pointer != NULL; }
 
 private:
-	atomic_t _refcount;
+    T* _pointer;
 };
 
 /***
@@ -0,0 +1,188 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_RESOURCE_BUNDLE_H
+#define MOOON_SYS_RESOURCE_BUNDLE_H
+#include "mooon/sys/lock.h"
+#include "mooon/sys/mmap.h"
+#include "mooon/utils/compressor.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 资源包（resource bundle）：将多个资源文件（如管理页面、模板）打包成一个带索引的二进制块，
+  * 代替resource_maker为每个文件生成一个C++数组，由resource_maker的--bundle模式生成。
+  *
+  * 格式（本机字节序，各部分按8字节对齐，数据按16字节对齐）：
+  * 1) 头部：魔数“MOOONRB1”、版本、资源个数、哈希桶个数和整个资源包的字节数
+  * 2) 哈希桶：开放寻址的哈希表，每个桶为资源的下标加1（0表示空桶），桶个数为2的幂，负载不超过一半
+  * 3) 资源表：每个资源的名字和数据在资源包中的偏移、存储大小、原始大小和压缩方式
+  * 4) 名字区和数据区
+  *
+  * 资源包可以：
+  * 1) 以.incbin汇编伪指令编译进程序（resource_maker --incbin生成对应的.cpp文件），用open打开
+  * 2) 附加到可执行文件（或任意文件）的末尾，末尾再加16字节的尾部，用open_file或open_self打开
+  * 3) 作为单独的文件，用open_file打开
+  */
+
+/** 资源包中的一个资源，即资源表中的一项 */
+typedef struct
+{
+    uint64_t name_offset;   /** 名字在资源包中的偏移，名字不以'\0'结尾 */
+    uint64_t data_offset;   /** 数据在资源包中的偏移 */
+    uint64_t stored_size;   /** 存储（压缩后）的字节数 */
+    uint64_t original_size; /** 原始（解压后）的字节数 */
+    uint32_t name_length;
+    uint32_t compression;   /** utils::compression_t，compression_none表示未压缩 */
+}resource_entry_t;
+
+/***
+  * 只读的资源包，按名字O(1)查找，
+  * 未压缩的资源直接返回资源包中的地址（零拷贝），
+  * 压缩的资源在第一次get时解压到缓存中，之后返回缓存的地址，地址在close之前一直有效。
+  * 打开后可多线程并发get。
+  *
+  * 使用示例（资源包附加在可执行文件末尾）：
+  * mooon::sys::CResourceBundle bundle;
+  * bundle.open_self();
+  * size_t size = 0;
+  * const char* page = bundle.get("admin/index.html", &size);
+  */
+class CResourceBundle
+{
+public:
+    CResourceBundle();
+    ~CResourceBundle();
+
+    /***
+      * 打开内存中的资源包（如.incbin嵌入的），不复制，data在close之前须一直有效
+      * @exception: 格式不对时抛出utils::CException异常
+      */
+    void open(const void* data, size_t size);
+
+    /***
+      * 以mmap打开文件中的资源包，文件可以是资源包本身，也可以是末尾附加了资源包的文件（如可执行文件）
+      * @exception: 格式不对或文件中没有资源包时抛出utils::CException异常，
+      *             打开或映射文件出错时抛出CSyscallException异常
+      */
+    void open_file(const std::string& filepath);
+
+    /** 打开附加在当前可执行文件末尾的资源包，异常同open_file */
+    void open_self();
+
+    /** 关闭资源包，释放映射和解压缓存，之前get得到的地址不再有效 */
+    void close();
+
+    bool is_open() const { return _bundle != NULL; }
+
+    /** 资源个数 */
+    uint32_t get_entry_number() const { return _entry_number; }
+
+    /** 资源包的字节数 */
+    size_t get_size() const { return _size; }
+
+    /***
+      * 查找资源
+      * @return: 资源的下标，不存在时返回-1
+      */
+    int find(const std::string& name) const;
+
+    /** 下标为index的资源的名字 */
+    std::string get_name(uint32_t index) const;
+
+    /** 下标为index的资源表项 */
+    const resource_entry_t* get_entry(uint32_t index) const { return &_entries[index]; }
+
+    /***
+      * 取得资源的内容
+      * @size: 输出参数，资源的原始字节数
+      * @return: 资源内容的地址，在close之前有效，资源不存在时返回NULL
+      * @exception: 解压失败时抛出utils::CException异常
+      */
+    const char* get(const std::string& name, size_t* size);
+    const char* get(uint32_t index, size_t* size);
+
+    /** 解压缓存占用的字节数 */
+    size_t get_cached_bytes() const { return __atomic_load_n(&_cached_bytes, __ATOMIC_RELAXED); }
+
+private:
+    CResourceBundle(const CResourceBundle&);
+    CResourceBundle& operator =(const CResourceBundle&);
+
+private:
+    const char* _bundle;
+    size_t _size;
+    uint32_t _entry_number;
+    uint32_t _bucket_mask;
+    const uint32_t* _buckets;
+    const resource_entry_t* _entries;
+    mmap_t* _mmap;                      // open_file时的映射
+    std::vector<std::string*> _cache;   // 压缩资源的解压缓存，下标同资源
+    size_t _cached_bytes;
+    CLock _lock;                        // 只在解压时使用
+};
+
+/***
+  * 资源包的生成器，resource_maker的--bundle模式使用它
+  *
+  * 使用示例：
+  * mooon::sys::CResourceBundleWriter writer;
+  * writer.add("admin/index.html", html, mooon::utils::compression_zstd);
+  * writer.write_file("admin.bundle");
+  */
+class CResourceBundleWriter
+{
+public:
+    /***
+      * 增加一个资源，数据按compression压缩后存储，压缩后不比原始数据小时不压缩
+      * @exception: 名字重复或压缩失败时抛出utils::CException异常
+      */
+    void add(const std::string& name, const std::string& data, utils::compression_t compression=utils::compression_none);
+
+    /** 生成资源包，追加到bundle中 */
+    void write(std::string* bundle) const;
+
+    /***
+      * 生成资源包并写到文件，覆盖已有的文件
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void write_file(const std::string& filepath) const;
+
+    /***
+      * 生成资源包并附加到已有文件（如可执行文件）的末尾，之后可用CResourceBundle::open_file打开
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void append_to_file(const std::string& filepath) const;
+
+    uint32_t get_entry_number() const { return static_cast<uint32_t>(_names.size()); }
+
+private:
+    struct Resource
+    {
+        std::string data;
+        uint64_t original_size;
+        utils::compression_t compression;
+    };
+
+    std::vector<std::string> _names;
+    std::vector<Resource> _resources;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_RESOURCE_BUNDLE_H
@@ -0,0 +1,100 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_ROBUST_MUTEX_H
+#define MOOON_SYS_ROBUST_MUTEX_H
+#include "mooon/sys/syscall_exception.h"
+#include <pthread.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 进程间共享的健壮互斥锁（PTHREAD_PROCESS_SHARED + PTHREAD_MUTEX_ROBUST），
+  * pthread_mutex_t放在共享内存中，由创建共享内存的进程调用init初始化一次，
+  * 各进程再以它的地址构造CRobustMutex使用，同样可用于同一进程内的多线程互斥。
+  * 持有者未解锁就退出（如被kill -9）时，下一个加锁的得到锁并被告知，
+  * 由它检查和修复被保护的数据，锁随后恢复正常，而不是像普通的进程间锁那样从此死锁。
+  * 无竞争时只有用户态的原子操作，比flock快，也不依赖文件系统（flock在一些网络文件系统上不可靠）。
+  */
+class CRobustMutex
+{
+public:
+    /***
+      * 初始化共享内存中的互斥锁
+      * @exception: 出错抛出CSyscallException异常
+      */
+    static void init(pthread_mutex_t* mutex);
+
+    explicit CRobustMutex(pthread_mutex_t* mutex)
+        : _mutex(mutex)
+    {
+    }
+
+    /***
+      * 加锁，如果不能获取到锁，则一直等待到获取到锁为止
+      * @return: 上一个持有者未解锁就退出时返回true，被保护的数据可能只改了一半，须由调用者修复
+      * @exception: 出错抛出CSyscallException异常
+      */
+    bool lock();
+
+    /***
+      * 解锁
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void unlock();
+
+private:
+    pthread_mutex_t* _mutex;
+};
+
+/***
+  * 健壮互斥锁帮助类，构造时加锁，析构时解锁
+  */
+class RobustLockHelper
+{
+public:
+    explicit RobustLockHelper(CRobustMutex& mutex)
+        : _mutex(mutex)
+    {
+        _owner_died = mutex.lock();
+    }
+
+    ~RobustLockHelper()
+    {
+        try
+        {
+            _mutex.unlock();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /** 上一个持有者是否未解锁就退出了 */
+    bool is_owner_died() const { return _owner_died; }
+
+private:
+    RobustLockHelper(const RobustLockHelper&);
+    RobustLockHelper& operator =(const RobustLockHelper&);
+
+private:
+    CRobustMutex& _mutex;
+    bool _owner_died;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_ROBUST_MUTEX_H
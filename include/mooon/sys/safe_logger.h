@@ -20,9 +20,14 @@
 #define MOOON_SYS_SAFE_LOGGER_H
 #include <mooon/sys/log.h>
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/read_write_lock.h>
 #include <mooon/sys/syscall_exception.h>
+#include <mooon/utils/compressor.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <time.h>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
 // CSafeLogger支持：
@@ -32,6 +37,9 @@ SYS_NAMESPACE_BEGIN
 // 4) 通过环境变量名MOOON_LOG_FILESIZE来控制单个日志文件的大小
 // 5) 通过环境变量名MOOON_LOG_BACKUP来控制日志文件备份个数
 class CSafeLogger;
+class CAsyncLogFlusher;
+class CLogArchiver;
+class CTimeThread;
 
 // 根据程序文件创建CSafeLogger
 //
@@ -74,8 +82,22 @@ extern CSafeLogger* create_safe_logger(
         uint16_t log_line_size=8192,
         bool enable_syslog=false);
 
+// 归档时日志文件的滚动方式
+typedef enum
+{
+    log_rotate_size   = 0, // 只按大小滚动
+    log_rotate_hourly = 1, // 每小时滚动，期间超过大小也滚动
+    log_rotate_daily  = 2  // 每天滚动，期间超过大小也滚动
+}log_rotate_t;
+
 /**
   * 多线程和多进程安全的日志器
+  * 写同一文件的多个进程通过以文件路径命名的共享内存（/dev/shm/mooon_log_<哈希>）协调滚动：
+  * 其中的健壮进程间互斥锁代替.lock文件锁，持有锁的进程崩溃也不会死锁，
+  * 共享的文件大小在每次写入后原子地累加，判断是否需要滚动不再fstat，
+  * 共享的滚动次数让其它进程发现文件已被滚动并重新打开。
+  * 共享内存在其文件锁内初始化，创建者初始化到一半退出的由后来的进程重新初始化，
+  * 能映射共享内存的进程总是用同一把健壮互斥锁；只有/dev/shm不可用时才退回到.lock文件锁和fstat。
   */
 class CSafeLogger: public ILogger
 {
@@ -105,6 +127,8 @@ public:
     virtual void enable_auto_adddot(bool enabled);
     /** 是否自动添加换行符，如果已经有换行符，则不会再自动添加换行符 */
     virtual void enable_auto_newline(bool enabled);
+    /** 是否折叠连续的相同日志行，默认不折叠 */
+    virtual void enable_repeat_filter(bool enabled);
     /** 设置日志级别，跟踪日志级别不能通过它来设置 */
     virtual void set_log_level(log_level_t log_level);
     /** 设置单个文件的最大建议大小 */
@@ -164,17 +188,137 @@ public:
     /** 写二进制日志 */
     virtual void log_bin(const char* filename, int lineno, const char* module_name, const char* log, uint16_t size);
 
+public:
+    /***
+      * 开启异步写日志，默认为同步写，应在多线程写日志之前调用，只能开启不能关闭
+      * 开启后，日志行格式化后追加到调用线程自己的缓冲区，
+      * 由后台线程定时将各线程缓冲区的日志以writev批量写入文件，
+      * 滚动仍在写入后和其它进程互斥，所以多进程安全不变。
+      * 同一线程的日志保持顺序，不同线程间的日志在同一批次内按线程先后排列。
+      * @flush_milliseconds: 后台线程刷日志的间隔毫秒数
+      * @buffer_bytes: 单个线程缓冲的日志字节数达到该值时唤醒后台线程，
+      *                达到4倍时调用线程自己同步写入，以免内存无限增长
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void enable_async(uint32_t flush_milliseconds=100, uint32_t buffer_bytes=SIZE_64K);
+
+    /***
+      * 开启分片写日志，应在多线程写日志之前调用，只能开启不能关闭，不能和enable_async同时使用
+      * 开启后每个线程写自己的文件x.log.shard.<pid>.<tid>.<birth>.<segment>，
+      * 写日志不再加读写锁和滚动锁，多线程和多进程间没有任何共享的锁。
+      * 每条日志前加实时纳秒时间、线程内递增的序号和长度（格式见log_shard_merger.h），
+      * 由CLogShardMerger或工具log_shard_merger按时间合并回全局顺序。
+      * 段超过单个文件大小时换下一段，每个线程只保留备份个数的历史段；fork出的子进程写自己的分片。
+      * @exception: 如果已开启异步，抛出CSyscallException异常
+      */
+    void enable_shard();
+
+    /** 是否为分片写日志 */
+    bool is_sharded() const { return _shard_enabled; }
+
+    /** 是否为异步写日志 */
+    bool is_async() const { return _async_flusher != NULL; }
+
+    /***
+      * 开启归档，默认为按大小滚动并以序号重命名，应在多线程写日志之前调用，只能开启不能关闭
+      * 开启后，滚动出的文件以时间命名且不再重命名：
+      * 按小时为x.log.YYYYmmddHH，按天为x.log.YYYYmmdd，期间超过大小滚动的再加序号，如x.log.YYYYmmdd.1，
+      * 只按大小时为x.log.YYYYmmddHHMMSS。
+      * 写日志的线程在滚动锁内只做重命名和重新打开，
+      * 压缩（x.log.YYYYmmdd.gz，其它压缩方式见set_archive_compression）和删除超过备份个数的旧文件由后台线程完成，不阻塞写日志。
+      * @rotate: 滚动方式，按时间时以本地时间的整点或零点为界，重启后首次写日志时滚动上一周期的文件
+      * @compress: 是否压缩滚动出的文件，默认以gzip压缩
+      * @preallocate: 是否以fallocate为新文件预分配单个文件大小的空间以减少碎片，
+      *               不改变文件大小，按时间滚动出的未写满的文件在压缩或删除前仍占用预分配的空间
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void enable_archive(log_rotate_t rotate=log_rotate_daily, bool compress=true, bool preallocate=false);
+
+    /***
+      * 设置压缩滚动出的文件的方式，默认为gzip，应在enable_archive之前调用，
+      * 文件名加上对应的后缀（如zstd为x.log.YYYYmmdd.zst），
+      * zstd压缩率和速度都优于gzip，但须在编译时找到zstd库
+      * @level: 压缩级别，-1为默认级别
+      * @exception: 不支持的压缩方式抛出utils::CException异常
+      */
+    void set_archive_compression(utils::compression_t compression, int level=-1);
+
+    /** 将所有线程缓冲区中的日志写入文件，仅异步写时有效 */
+    void flush();
+
+    /***
+      * 日志头中的时间是否带微秒，默认带
+      * 不带微秒时，如果设置了time_thread，则时间取自time_thread，写日志时不再取系统时间
+      */
+    void enable_microseconds(bool enabled) { _microseconds_enabled = enabled; }
+    void set_time_thread(const CTimeThread* time_thread) { _time_thread = time_thread; }
+
+private:
+    friend class CAsyncLogFlusher;
+    friend class CLogArchiver;
+
+    // 异步写日志时，每个线程一个的缓冲区
+    struct ThreadLogBuffer
+    {
+        CSafeLogger* logger;
+        CLock lock;
+        std::string data;
+        bool exited; // 所属线程是否已退出，已退出的由后台线程写完后删除
+    };
+
+    // 分片写日志时，每个线程一个的分片
+    struct LogShard
+    {
+        CSafeLogger* logger;
+        int fd;
+        uint32_t generation; // fork的代数，不同时说明是fork出的子进程，需换新的分片
+        uint64_t birth;      // 分片创建的实时纳秒时间，区分复用的pid和tid
+        uint64_t sequence;   // 最后一条日志的序号
+        uint32_t segment;
+        off_t size;          // 当前段的大小
+    };
+
+    static void on_thread_exit(void* param);
+    static void on_shard_exit(void* param);
+    void shard_log(const char* log_line, int log_line_size);
+    bool open_shard_segment(LogShard* shard);
+    void release_log_shards();
+    ThreadLogBuffer* get_thread_log_buffer();
+    void async_log(const char* log_line, int log_line_size);
+    void writev_log(std::vector<std::string>& log_lines);
+    void release_log_buffers();
+
+private:
+    void archive_log();
+    void archive_files(const std::vector<std::string>& filepaths);
+    void compress_log(const std::string& filepath) const;
+    void remove_old_logs() const;
+    void preallocate_log(int fd) const;
+    bool is_rotate_due() const;
+    void release_archiver();
+
+private:
+    struct SharedRotation;
+    SharedRotation* open_shared_rotation(const char* name, const char* filepath, bool* collided);
+    void attach_shared_rotation();
+    bool is_log_stale() const;
+    void reopen_log();
+    void sync_shared_size(int fd);
+
 private:
     bool need_rotate(int fd) const;
+    void check_rotate(int log_fd);
     void do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
     void rotate_log();
     void write_log(const char* log_line, int log_line_size);
+    void output_log(const char* log_line, int log_line_size);
+    void log_repeated(log_level_t log_level, uint32_t repeated_number);
 
 private:
     int prepare_log_fd();
 
 private:
-    CReadWriteLock _read_write_lock;
+    CDistributedReadWriteLock _read_write_lock; // 每条日志都加读锁，只在打开和滚动时加写锁
     int _log_fd;
 
 private:
@@ -187,6 +331,9 @@ private:
     bool _trace_log_enabled;
     bool _raw_log_enabled;
     bool _raw_record_time;
+    bool _microseconds_enabled;
+    const CTimeThread* _time_thread;
+    CLogRepeatFilter _repeat_filter;
 
 private:
     bool _screen_enabled;
@@ -196,6 +343,34 @@ private:
     const std::string _log_filename;
     const std::string _log_filepath;
     const std::string _log_shortname;
+
+private:
+    uint32_t _async_buffer_bytes;
+    CAsyncLogFlusher* _async_flusher;
+    pthread_key_t _log_buffer_key;
+    CLock _flush_lock;        // 保证同一线程的日志按序写入
+    CLock _log_buffers_lock;
+    std::vector<ThreadLogBuffer*> _log_buffers;
+
+private:
+    bool _shard_enabled;
+    pthread_key_t _shard_key;
+    CLock _log_shards_lock;
+    std::vector<LogShard*> _log_shards;
+
+private:
+    CLogArchiver* _archiver;  // 不为NULL时表示开启了归档
+    log_rotate_t _rotate;
+    bool _compress_enabled;
+    utils::compression_t _archive_compression;
+    int _archive_level;
+    bool _preallocate_enabled;
+    time_t _file_period_start; // 当前文件所属周期的开始时间，只在滚动锁内修改
+    time_t _next_rotate_time;  // 当前周期的结束时间，到达时按时间滚动
+
+private:
+    SharedRotation* _shared_rotation; // 为NULL时（/dev/shm不可用）以.lock文件锁互斥滚动
+    uint64_t _log_generation;         // _log_fd打开时的滚动次数，和共享的不同时需重新打开
 };
 
 SYS_NAMESPACE_END
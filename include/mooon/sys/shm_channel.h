@@ -0,0 +1,155 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_SHM_CHANNEL_H
+#define MOOON_SYS_SHM_CHANNEL_H
+#include "mooon/sys/syscall_exception.h"
+#include <stdint.h>
+#include <sys/types.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 基于POSIX共享内存（shm_open）或memfd的跨进程消息通道，多生产者单消费者（MPSC），
+  * 生产者和消费者可在不同进程，消息为变长，直接在共享内存中写入和读取，不经过内核拷贝。
+  *
+  * 环形缓冲区中每条消息为8字节头加数据，按8字节对齐。生产者以CAS推进tail占用空间，
+  * 占用时头写为负的长度，写完数据后改为正的长度（提交），消费者只读已提交的消息，
+  * 消费后将其空间清零再推进head，因此head之后的空间总是零，空间不足到环尾时以填充消息补齐。
+  * 等待和唤醒使用共享内存中的futex，只有对方在等待时才有唤醒的系统调用。
+  *
+  * 崩溃恢复：
+  * 1) 头和位置都在共享内存中，消费者进程重启后重新create或open，从上次的head继续读，
+  *    pop之前崩溃的消息会被再次读到（至少一次）
+  * 2) 生产者在占用空间后、提交前崩溃，会使消费者停在这条消息上，
+  *    消费者可调用recover_stalled，将停留超过指定时长的未提交消息改为填充消息跳过，
+  *    之后该生产者如再提交，commit返回false
+  *
+  * 使用示例（父子进程，子进程为生产者）：
+  * CShmChannel channel;
+  * channel.create(NULL, 1024*1024); // memfd，fork后子进程继承
+  * if (0 == fork())
+  * {
+  *     channel.push("hello", 5);
+  *     exit(0);
+  * }
+  * const char* data;
+  * uint32_t size;
+  * while (!channel.front(&data, &size))
+  *     channel.wait(1000);
+  * channel.pop();
+  */
+class CShmChannel
+{
+public:
+    CShmChannel();
+    ~CShmChannel();
+
+    /***
+      * 创建通道，如果已存在且有效则使用已存在的（如进程重启后）
+      * @name: shm_open的名字，如“/mooon_log_agent”，为NULL时使用memfd
+      *        （只能通过fork继承或以SCM_RIGHTS传递get_fd()给其它进程）
+      * @capacity: 环形缓冲区的字节数，向上取整为2的幂，最小4096
+      * @return: 新创建的返回true，使用已存在的返回false
+      * @exception: 出错抛出CSyscallException异常
+      */
+    bool create(const char* name, uint32_t capacity);
+
+    /***
+      * 打开已存在的通道
+      * @exception: 出错或不是有效的通道时抛出CSyscallException异常
+      */
+    void open(const char* name);
+    void open_fd(int fd); /** fd由调用者关闭 */
+
+    /** 解除映射并关闭，不删除共享内存 */
+    void close();
+
+    /** 删除以name创建的共享内存，已打开的不受影响 */
+    static void remove(const char* name);
+
+    int get_fd() const { return _fd; }
+    uint32_t get_capacity() const { return _capacity; }
+    uint32_t get_max_message_size() const { return _capacity/2 - 8; }
+
+public: // 生产者，可以多个线程或进程同时调用
+    /***
+      * 占用size字节的空间，之后直接往返回的地址写入数据，再调用commit提交，
+      * 占用和提交之间应尽量短，因为消费者只能按序读取
+      * @return: 空间不足或size超过get_max_message_size()时返回NULL
+      */
+    char* claim(uint32_t size);
+
+    /***
+      * 提交claim得到的消息，如有消费者在等待则唤醒它
+      * @return: 消息已被recover_stalled跳过时返回false
+      */
+    bool commit(char* data);
+
+    /** 写入一条消息，空间不足时返回false */
+    bool push(const void* data, uint32_t size);
+
+    /** 写入一条消息，空间不足时最多等待milliseconds毫秒 */
+    bool timed_push(const void* data, uint32_t size, uint32_t milliseconds);
+
+public: // 消费者，同时只能有一个
+    /***
+      * 取得队首的消息，data直接指向共享内存，在pop之前有效
+      * @return: 没有已提交的消息时返回false
+      */
+    bool front(const char** data, uint32_t* size);
+
+    /** 移除队首的消息，其空间清零后供生产者再用 */
+    void pop();
+
+    /***
+      * 等待消息，有已提交的消息或超时返回
+      * @return: 有消息时返回true
+      */
+    bool wait(uint32_t milliseconds);
+
+    /***
+      * 队首的消息已未提交超过milliseconds毫秒（生产者可能已崩溃）时，将其改为填充消息跳过
+      * @return: 跳过了消息时返回true
+      */
+    bool recover_stalled(uint32_t milliseconds);
+
+    /** 已写入但未消费的字节数 */
+    uint64_t get_used_bytes() const;
+
+private:
+    struct ChannelHeader;
+
+private:
+    // new_capacity不为0时表示新建的，映射后初始化头
+    void attach(int fd, bool owned, uint32_t new_capacity);
+    uint64_t* record_at(uint64_t position) const;
+    void skip_padding();
+
+private:
+    int _fd;
+    bool _owned_fd;          /** 是否由本对象关闭_fd */
+    ChannelHeader* _header;
+    char* _ring;
+    size_t _mapped_size;
+    uint32_t _capacity;
+    uint64_t _stalled_head;  /** 发现队首未提交时的head，及发现的时间 */
+    uint64_t _stalled_milliseconds;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_SHM_CHANNEL_H
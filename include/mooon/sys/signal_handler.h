@@ -48,6 +48,20 @@ SYS_NAMESPACE_BEGIN
 //    比如调用了CSignalHandler::block_signal(SIGTERM)进程阻塞，则在未调用CSignalHandler::wait_signal()或CSignalHandler::handle()之前，
 //    则未处理的SIGTERM信号总是只有一个，后续的SIGTERM都被丢弃，直到已被处理。
 
+/***
+ * 信号观察者，CMainHelper和net::CSignalFd的使用者实现它，
+ * 与CSignalHandler::handle(Object*)要求的四个成员函数相同
+ */
+class ISignalObserver
+{
+public:
+    virtual ~ISignalObserver() {}
+    virtual void on_terminated() {}
+    virtual void on_child_end(pid_t child_pid, int child_exited_status) {}
+    virtual void on_signal_handler(int signo) {}
+    virtual void on_exception(int errcode) {}
+};
+
 /***
  * Linux信号处理工具
  * 在主线程中阻塞需要处理的信号
@@ -78,6 +92,22 @@ public:
      */
     static int wait_signal() throw ();
 
+    /***
+     * 取得已被block_signal阻塞的信号集，用于创建signalfd（见net/signal_fd.h）
+     * 调用成功返回true，否则返回false，出错原因可通过errno取得
+     */
+    static bool get_blocked_signals(sigset_t* sigset) throw ();
+
+    /***
+     * 为致命信号（SIGSEGV、SIGBUS、SIGILL、SIGFPE和SIGABRT）安装处理函数，
+     * 信号发生时先回调on_fatal，之后恢复默认处理并再次触发该信号，进程仍然coredump或被父进程重启，
+     * 同时为调用线程（通常为主线程）安装备用信号栈，该线程栈溢出引起的SIGSEGV也能被处理
+     * @on_fatal 在信号处理上下文中执行，只能调用异步信号安全的函数（如write），
+     *           如CFlightRecorder::dump_on_signal
+     * 调用成功返回true，否则返回false，出错原因可通过errno取得
+     */
+    static bool handle_fatal_signals(void (*on_fatal)(int signo)) throw ();
+
     /***
      * 等待信号
      * 如果没有信号发生，则调用会被阻塞
@@ -113,9 +143,17 @@ public:
     template <class Object>
     static void handle(Object* object) throw ();
 
+    /***
+     * 分发一个已取得的信号，回调与handle相同，
+     * 用于不经sigwait取得信号的场合，如从signalfd读到的信号
+     * @signo 发生的信号，为-1时回调on_exception(errno)
+     */
+    template <class Object>
+    static void dispatch(Object* object, int signo) throw ();
+
 private:
     template <class Object>
-    static void do_handle(Object* object,
+    static void do_handle(Object* object, int signo,
             void (*on_terminated)(),
             void (*on_child_end)(pid_t child_pid, int child_exited_status),
             void (*on_signal_handler)(int signo),
@@ -131,9 +169,13 @@ private:
         void on_exception(int errcode) {}
     };
 
+private:
+    static void on_fatal_signal(int signo);
+
 private:
     static sigset_t _sigset;
     static std::vector<int> _signo_array;
+    static void (*_on_fatal)(int signo);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -237,25 +279,29 @@ inline void CSignalHandler::handle(
         void (*on_signal_handler)(int signo),
         void (*on_exception)(int errcode)) throw ()
 {
-    do_handle<NullObject>(NULL, on_terminated, on_child_end, on_signal_handler, on_exception);
+    do_handle<NullObject>(NULL, wait_signal(), on_terminated, on_child_end, on_signal_handler, on_exception);
 }
 
 template <class Object>
 inline void CSignalHandler::handle(Object* object) throw ()
 {
-    do_handle(object, NULL, NULL, NULL, NULL);
+    do_handle(object, wait_signal(), NULL, NULL, NULL, NULL);
+}
+
+template <class Object>
+inline void CSignalHandler::dispatch(Object* object, int signo) throw ()
+{
+    do_handle(object, signo, NULL, NULL, NULL, NULL);
 }
 
 template <class Object>
 inline void CSignalHandler::do_handle(
-        Object* object,
+        Object* object, int signo,
         void (*on_terminated)(),
         void (*on_child_end)(pid_t child_pid, int child_exited_status),
         void (*on_signal_handler)(int signo),
         void (*on_exception)(int errcode)) throw ()
 {
-    int signo = wait_signal();
-
     if (-1 == signo)
     {
         if (object != NULL)
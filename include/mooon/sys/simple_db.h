@@ -27,6 +27,45 @@ SYS_NAMESPACE_BEGIN
 typedef std::vector<std::string> DBRow; // 用来存储一行所有字段的值
 typedef std::vector<DBRow> DBTable;     // 用来存储所有行
 
+// 字段的视图，指向DB客户端库内部的缓冲区，不复制字段值
+struct DBField
+{
+    const char* data; // 字段在DB表中为NULL时，指向连接的null_value
+    size_t size;
+    bool is_null;
+};
+
+/**
+ * 流式读取结果集的游标，由DBConnection::open_cursor创建，使用完后delete，
+ * 每次fetch只取一行，不将整个结果集读入内存，
+ * get_field返回的视图只在下一次fetch或游标被删除之前有效。
+ *
+ * 游标存在期间，不能在同一连接上执行其它操作。
+ *
+ * 使用示例：
+ * utils::ScopedPtr<DBCursor> db_cursor(db_connection->open_cursor("select id,name from test"));
+ * while (db_cursor->fetch())
+ * {
+ *     const DBField& id = db_cursor->get_field(0);
+ *     printf("%.*s\n", (int)id.size, id.data);
+ * }
+ */
+class DBCursor
+{
+public:
+    virtual ~DBCursor() {}
+
+    /** 取下一行，没有更多的行时返回false，出错抛出CDBException异常 */
+    virtual bool fetch() = 0;
+
+    int get_field_number() const { return static_cast<int>(_fields.size()); }
+    const DBField& get_field(int index) const { return _fields[index]; }
+    std::string get_field_string(int index) const { return std::string(_fields[index].data, _fields[index].size); }
+
+protected:
+    std::vector<DBField> _fields; // 当前行各字段的视图
+};
+
 // DB连接、读和写超时时长，单位为秒
 enum
 {
@@ -104,6 +143,13 @@ public:
     // str 需要编码的字符串，返回被编码后的字符串
     virtual std::string escape_string(const std::string& str) const = 0;
 
+    // 将[str, str+size)编码后追加到out，用于拼接大批量的SQL，
+    // 默认调用escape_string，实现可以重写以避免临时字符串
+    virtual void append_escaped_string(const char* str, size_t size, std::string* out) const
+    {
+        out->append(escape_string(std::string(str, size)));
+    }
+
     /***
      * 设置需要连接的DB的IP和服务端口号
      * 注意，只有在open()或reopen()之前调用才生效
@@ -225,6 +271,13 @@ public:
      */
     virtual std::string query(const char* format, ...) __attribute__((format(printf, 2, 3))) = 0;
 
+    /**
+     * 以游标方式查询，结果集不在客户端物化，适用于大结果集，
+     * 返回的游标由调用者delete，出错抛出CDBException异常，
+     * 不支持游标的连接抛出错误码为DB_NOT_SUPPORTED的CDBException异常
+     */
+    virtual DBCursor* open_cursor(const char* format, ...) __attribute__((format(printf, 2, 3))) = 0;
+
     /***
       * 数据库insert和update更新操作
       * 对于MySQL如果update的值并没变化返回0，否则返回变修改的行数
@@ -279,6 +332,7 @@ public:
     virtual void query(DBTable& db_table, const char* format, ...) __attribute__((format(printf, 3, 4)));
     virtual void query(DBRow& db_row, const char* format, ...) __attribute__((format(printf, 3, 4)));
     virtual std::string query(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    virtual DBCursor* open_cursor(const char* format, ...) __attribute__((format(printf, 2, 3)));
 
     virtual void ping();
     virtual void commit();
@@ -292,6 +346,7 @@ public:
 
 private:
     virtual void do_query(DBTable& db_table, const char* sql, int sql_length) = 0;
+    virtual DBCursor* do_open_cursor(const char* sql, int sql_length);
 
 protected:
     const size_t _sql_size; // 支持的最大SQL语句长度，单位为字节数，不含结尾符
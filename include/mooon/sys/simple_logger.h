@@ -32,6 +32,8 @@
 #include <fcntl.h>
 #include <sstream>
 #include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
 #include <string>
 #include <syslog.h> 
 #include <sys/stat.h>
@@ -120,7 +122,59 @@ do { \
         logger->fetal(__FILE__, __LINE__, format, ##__VA_ARGS__); \
     } \
 } while(false)
-    
+
+/***
+  * 限速的日志宏，每个调用点每秒最多输出rate行，被限制的行只计数，
+  * 下一次允许时先输出一行“N similar lines suppressed”，
+  * 和CSimpleLogger一样非多线程安全
+  */
+#define __SIMPLE_LOG_RATELIMIT(logger, level_macro, rate, format, ...) \
+do { \
+    static ::mooon::sys::SimpleLogSiteLimit simple_log_site_limit = { rate, 0, 0, 0 }; \
+    unsigned int simple_log_suppressed_number; \
+    if (simple_log_site_limit.allow(&simple_log_suppressed_number)) { \
+        if (simple_log_suppressed_number > 0) \
+            level_macro(logger, "%u similar lines suppressed", simple_log_suppressed_number); \
+        level_macro(logger, format, ##__VA_ARGS__); \
+    } \
+} while(false)
+
+#define __SIMPLE_LOG_DEBUG_RATELIMIT(logger, rate, format, ...)   __SIMPLE_LOG_RATELIMIT(logger, __SIMPLE_LOG_DEBUG, rate, format, ##__VA_ARGS__)
+#define __SIMPLE_LOG_INFO_RATELIMIT(logger, rate, format, ...)    __SIMPLE_LOG_RATELIMIT(logger, __SIMPLE_LOG_INFO, rate, format, ##__VA_ARGS__)
+#define __SIMPLE_LOG_ERROR_RATELIMIT(logger, rate, format, ...)   __SIMPLE_LOG_RATELIMIT(logger, __SIMPLE_LOG_ERROR, rate, format, ##__VA_ARGS__)
+#define __SIMPLE_LOG_WARNING_RATELIMIT(logger, rate, format, ...) __SIMPLE_LOG_RATELIMIT(logger, __SIMPLE_LOG_WARNING, rate, format, ##__VA_ARGS__)
+
+/***
+  * 日志调用点的限速状态，按秒计数，为聚合类型，以便作为静态变量时不需要构造
+  */
+struct SimpleLogSiteLimit
+{
+    unsigned int rate;              /** 每秒最多输出的行数 */
+    time_t second;                  /** 当前计数的秒 */
+    unsigned int number;            /** 当前秒已输出的行数 */
+    unsigned int suppressed_number; /** 上一次允许以来被限制的行数 */
+
+    bool allow(unsigned int* suppressed)
+    {
+        const time_t now = time(NULL);
+        if (now != second)
+        {
+            second = now;
+            number = 0;
+        }
+        if (number >= rate)
+        {
+            ++suppressed_number;
+            return false;
+        }
+
+        ++number;
+        *suppressed = suppressed_number;
+        suppressed_number = 0;
+        return true;
+    }
+};
+
 // 默认的文件模式
 #ifndef FILE_DEFAULT_PERM
 #define FILE_DEFAULT_PERM (S_IRUSR|S_IWUSR | S_IRGRP | S_IROTH)
@@ -159,6 +213,25 @@ public:
     void warning(const char* file, int line, const char* format, ...) __attribute__((format(printf, 4, 5)));
     void fetal(const char* file, int line, const char* format, ...) __attribute__((format(printf, 4, 5)));
 
+    /***
+      * 是否折叠连续的相同日志行（级别、代码位置和内容都相同），默认不折叠，
+      * 折叠的行在出现不同的行或超过10秒时以“last message repeated N times”汇总
+      */
+    void enable_repeat_filter(bool enabled) { _repeat_enabled = enabled; }
+
+    /***
+      * 启用写缓冲区，默认不启用，每条日志直接写文件。
+      * 启用后日志先追加到本对象的缓冲区，在缓冲区满、距上次刷新超过flush_seconds秒（在下一条日志时判断）、
+      * 或者为ERROR和FETAL级别时，以一次write写入文件，
+      * 由O_APPEND保证一次刷新的内容不与其它进程写的交错，但只是在刷新的边界上，不再是每条日志。
+      * 对象析构时刷新，进程异常退出时缓冲区中的日志会丢失，fork前应先调用flush。
+      * @buffer_size 缓冲区的大小，为0表示不启用
+      */
+    void set_write_buffer(uint32_t buffer_size, uint32_t flush_seconds=1);
+
+    /** 将写缓冲区中的日志写入文件 */
+    void flush();
+
     /** 得到含文件名的日志文件路径*/
     const std::string& get_log_filepath() const;
 
@@ -179,7 +252,9 @@ public:
 
 private:
     void print(const char* file, int line, const char* level, const char* format, va_list& ap);
-    bool need_rotate() const;        /** 是否需要滚动了 */
+    void output(const struct iovec* iov, int iovcnt, bool flush_now); /** 写入文件或追加到写缓冲区 */
+    void on_written(ssize_t bytes_writed); /** 写入文件后，更新文件大小并按需滚动 */
+    bool need_rotate();              /** 是否需要滚动了，以缓存的文件大小判断 */
     bool need_rotate(int fd) const;  /** 是否需要滚动了 */
     void reset();                    /** 复位状态值 */
     void rotate_log();               /** 滚动日志 */
@@ -194,6 +269,21 @@ private:
     std::string _log_filepath; /** 含文件名的日志文件路径 */
     std::string _tag1;         /** 自定义的标记1 */
     std::string _tag2;         /** 自定义的标记2 */
+
+private:
+    bool _repeat_enabled;      /** 是否折叠连续的相同日志行 */
+    uint64_t _last_hash;       /** 上一行的哈希值 */
+    const char* _last_level;
+    unsigned int _repeated_number;
+    time_t _report_time;       /** 上一次输出的时间 */
+
+private:
+    off_t _file_size;          /** 缓存的文件大小，为上一次fstat的大小加上之后本对象写入的 */
+    time_t _stat_time;         /** 上一次fstat的时间 */
+    uint32_t _buffer_size;     /** 写缓冲区的大小，为0表示不启用 */
+    uint32_t _flush_seconds;
+    time_t _flush_time;        /** 上一次刷新的时间 */
+    std::string _write_buffer;
 };
 
 /** 万用类型转换函数 */
@@ -262,13 +352,26 @@ inline CSimpleLogger::CSimpleLogger(
        _filename(filename),
        _log_size(log_size),
        _log_numer(log_numer),
-       _record_size(record_size)
+       _record_size(record_size),
+       _repeat_enabled(false),
+       _last_hash(0),
+       _last_level(NULL),
+       _repeated_number(0),
+       _report_time(0),
+       _file_size(0),
+       _stat_time(0),
+       _buffer_size(0),
+       _flush_seconds(0),
+       _flush_time(0)
 {
     _log_filepath = _log_dir + std::string("/") + _filename;
     _fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
 
     if (_fd != -1)
     {
+        _file_size = get_file_size(_fd);
+        _stat_time = time(NULL);
+
         // 不能太小气了
         if (_log_size < 1024)
         {
@@ -286,7 +389,21 @@ inline CSimpleLogger::CSimpleLogger(
 inline CSimpleLogger::~CSimpleLogger()
 {
     if (_fd != -1)
-        close(_fd);
+    {
+        if (_repeated_number > 0)
+        {
+            const std::string summary = std::string("[") + get_current_datetime() + std::string("][") + _last_level + std::string("][")
+                                      + any2string(getpid()) + std::string("]last message repeated ") + any2string(_repeated_number) + std::string(" times\n");
+            struct iovec iov;
+            iov.iov_base = const_cast<char*>(summary.data());
+            iov.iov_len = summary.size();
+            output(&iov, 1, false);
+        }
+
+        flush();
+        if (_fd != -1)
+            close(_fd);
+    }
 }
 
 inline bool CSimpleLogger::is_ok() const
@@ -366,6 +483,29 @@ inline void CSimpleLogger::fetal(const char* file, int line, const char* format,
     }
 }
 
+inline void CSimpleLogger::set_write_buffer(uint32_t buffer_size, uint32_t flush_seconds)
+{
+    flush();
+    _buffer_size = buffer_size;
+    _flush_seconds = flush_seconds;
+    _flush_time = time(NULL);
+    _write_buffer.reserve(buffer_size);
+}
+
+inline void CSimpleLogger::flush()
+{
+    if ((_fd != -1) && !_write_buffer.empty())
+    {
+        // 整个缓冲区一次write
+        ssize_t bytes_writed = write(_fd, _write_buffer.data(), _write_buffer.size());
+        _write_buffer.clear();
+        _flush_time = time(NULL);
+
+        if (bytes_writed > 0)
+            on_written(bytes_writed);
+    }
+}
+
 inline const std::string& CSimpleLogger::get_log_filepath() const
 {
     return _log_filepath;
@@ -445,42 +585,116 @@ inline void CSimpleLogger::print(const char* file, int line, const char* level,
         iov[1].iov_len = fix_vsnprintf(content_buffer, content_size, format, ap);
         content_buffer[iov[1].iov_len - 1] = '\n'; // 添加换行符
 
-        // 写入文件
-        ssize_t bytes_writed = writev(_fd, iov, sizeof(iov)/sizeof(iov[0]));
+        // 折叠连续的相同行，raw日志不折叠
+        std::string summary;
+        if (_repeat_enabled && (level != NULL))
+        {
+            uint64_t hash = 14695981039346656037ULL; // FNV-1a
+            for (size_t i=0; i<iov[1].iov_len; ++i)
+                hash = (hash ^ static_cast<unsigned char>(content_buffer[i])) * 1099511628211ULL;
+            hash ^= reinterpret_cast<uintptr_t>(level) ^ reinterpret_cast<uintptr_t>(file) ^ (static_cast<uint64_t>(line) << 32);
+
+            const time_t now = time(NULL);
+            if ((hash == _last_hash) && (now < _report_time + 10))
+            {
+                ++_repeated_number;
+                delete []content_buffer;
+                return;
+            }
+            if (_repeated_number > 0)
+            {
+                summary = std::string("[") + get_current_datetime() + std::string("][") + _last_level + std::string("][")
+                        + any2string(getpid()) + std::string("]last message repeated ") + any2string(_repeated_number) + std::string(" times\n");
+            }
+
+            _last_hash = hash;
+            _last_level = level;
+            _repeated_number = 0;
+            _report_time = now;
+        }
+
+        // 写入文件，有重复行的汇总时一起写入，ERROR和FETAL总是立即刷新
+        struct iovec iov_array[3];
+        int iovcnt = 0;
+        if (!summary.empty())
+        {
+            iov_array[iovcnt].iov_base = const_cast<char*>(summary.data());
+            iov_array[iovcnt++].iov_len = summary.size();
+        }
+        iov_array[iovcnt++] = iov[0];
+        iov_array[iovcnt++] = iov[1];
+        output(iov_array, iovcnt, (level != NULL) && ((0 == strcmp(level, "ERROR")) || (0 == strcmp(level, "FETAL"))));
         delete []content_buffer;
+    }
+}
 
+inline void CSimpleLogger::output(const struct iovec* iov, int iovcnt, bool flush_now)
+{
+    if (0 == _buffer_size)
+    {
+        ssize_t bytes_writed = writev(_fd, iov, iovcnt);
         if (bytes_writed > 0)
+            on_written(bytes_writed);
+        return;
+    }
+
+    size_t size = 0;
+    for (int i=0; i<iovcnt; ++i)
+        size += iov[i].iov_len;
+    if (_write_buffer.size() + size > _buffer_size)
+        flush();
+
+    for (int i=0; i<iovcnt; ++i)
+        _write_buffer.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    if (flush_now
+     || (_write_buffer.size() >= _buffer_size)
+     || (time(NULL) >= _flush_time + static_cast<time_t>(_flush_seconds)))
+        flush();
+}
+
+inline void CSimpleLogger::on_written(ssize_t bytes_writed)
+{
+    _file_size += bytes_writed;
+
+    // 滚动处理
+    if (need_rotate())
+    {
+        // 加文件锁
+        std::string lock_path = _log_dir + std::string("/.") + _filename + std::string(".lock");
+        FileLocker file_locker(lock_path.c_str(), true); // 确保这里一定加锁
+
+        // _fd可能已被其它进程滚动了，所以这里需要重新open一下
+        std::string log_filepath = _log_dir + std::string("/") + _filename;
+        int fd = open(log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+
+        // 需要再次判断，原因是可能其它进程已处理过了
+        if (need_rotate(fd))
         {
-            // 滚动处理
-            if (need_rotate())
-            {    
-                // 加文件锁
-                std::string lock_path = _log_dir + std::string("/.") + _filename + std::string(".lock");
-                FileLocker file_locker(lock_path.c_str(), true); // 确保这里一定加锁
-                
-                // _fd可能已被其它进程滚动了，所以这里需要重新open一下
-                std::string log_filepath = _log_dir + std::string("/") + _filename;
-                int fd = open(log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
-
-                // 需要再次判断，原因是可能其它进程已处理过了
-                if (need_rotate(fd))
-                {
-                    close(fd);
-                    rotate_log();
-                }
-                else // 其它进程完成了滚动
-                {
-                    close(_fd);
-                    _fd = fd;
-                }
-            }
+            close(fd);
+            rotate_log();
         }
+        else // 其它进程完成了滚动
+        {
+            close(_fd);
+            _fd = fd;
+        }
+
+        _file_size = (-1 == _fd)? 0: get_file_size(_fd);
+        _stat_time = time(NULL);
     }
 }
 
-inline bool CSimpleLogger::need_rotate() const
+// 其它进程也在写同一个文件，或者已滚动了文件，
+// 所以缓存的大小超过时或每秒以fstat校正一次，而不是每条日志都fstat
+inline bool CSimpleLogger::need_rotate()
 {
-    return get_file_size(_fd) > static_cast<off_t>(_log_size);
+    const time_t now = time(NULL);
+    if ((_file_size <= static_cast<off_t>(_log_size)) && (now == _stat_time))
+        return false;
+
+    _stat_time = now;
+    _file_size = get_file_size(_fd);
+    return _file_size > static_cast<off_t>(_log_size);
 }
 
 inline bool CSimpleLogger::need_rotate(int fd) const
@@ -0,0 +1,181 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_SLAB_MEM_POOL_H
+#define MOOON_SYS_SLAB_MEM_POOL_H
+#include "mooon/sys/mem_pool.h"
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 一个尺寸级别的统计
+  */
+typedef struct
+{
+    uint32_t class_size;      /** 该级别每块内存的大小 */
+    uint32_t pool_size;       /** 池中内存块总数 */
+    uint32_t used_number;     /** 已分配出去的内存块数（包括从堆上分配的） */
+    uint32_t heap_number;     /** 池不够时从堆上分配、还未回收的内存块数 */
+    uint64_t requested_bytes; /** 已分配出去的内存实际请求的字节数之和 */
+}slab_class_stat_t;
+
+/***
+  * 多尺寸级别的内存池，性能高但非线程安全
+  * 管理一组CRawMemPool，级别大小按几何级数增长，
+  * 分配时选择不小于请求大小的最小级别，超过最大级别的直接从堆上分配。
+  * 回收时需传入分配时请求的大小，以便定位级别而无需在内存块中存储头部。
+  */
+class CSlabMemPool
+{
+public:
+    CSlabMemPool() throw ();
+    ~CSlabMemPool() throw ();
+
+    /***
+      * 创建内存池
+      * @min_size: 最小级别的大小，会向上对齐到8字节
+      * @max_size: 最大级别的大小，不能超过65535
+      * @growth_percent: 相邻级别大小的增长百分比，如100表示每级翻倍，25表示每级增长1/4
+      * @bucket_number: 每个级别的内存块个数
+      * @use_heap: 级别内存不够时，是否从堆上分配
+      */
+    void create(uint16_t min_size, uint16_t max_size, uint16_t growth_percent, uint32_t bucket_number, bool use_heap=true);
+
+    /** 销毁内存池 */
+    void destroy() throw ();
+
+    /***
+      * 分配内存
+      * @size: 需要的字节数
+      * @return: 如果不够且不允许从堆上分配，则返回NULL
+      */
+    void* allocate(size_t size) throw ();
+
+    /***
+      * 回收内存
+      * @ptr: 由allocate返回的内存
+      * @size: 分配时请求的字节数
+      * @return: 回收成功返回true，否则返回false
+      */
+    bool reclaim(void* ptr, size_t size) throw ();
+
+    /** 得到级别个数 */
+    uint32_t get_class_number() const throw () { return static_cast<uint32_t>(_pools.size()); }
+
+    /** 得到第index个级别的统计 */
+    slab_class_stat_t get_class_stat(uint32_t index) const throw ();
+
+    /** 得到超过最大级别、直接从堆上分配还未回收的内存块数 */
+    uint32_t get_large_number() const throw () { return _large_number; }
+
+    /***
+      * 得到占用率，即已分配内存块数占池中内存块总数的比例
+      */
+    double get_occupancy() const throw ();
+
+    /***
+      * 得到内部碎片率，即已分配内存中未被请求使用的部分所占的比例，
+      * 为0表示没有浪费
+      */
+    double get_fragmentation() const throw ();
+
+private:
+    int get_class_index(size_t size) const throw ();
+
+private:
+    std::vector<CRawMemPool*> _pools;
+    std::vector<slab_class_stat_t> _stats;
+    uint32_t _large_number;
+};
+
+/***
+  * CSlabMemPool的线程安全版本
+  */
+class CThreadSlabMemPool
+{
+public:
+    CThreadSlabMemPool();
+    void create(uint16_t min_size, uint16_t max_size, uint16_t growth_percent, uint32_t bucket_number, bool use_heap=true);
+    void destroy();
+    void* allocate(size_t size);
+    bool reclaim(void* ptr, size_t size);
+    uint32_t get_class_number() const;
+    slab_class_stat_t get_class_stat(uint32_t index) const;
+    double get_occupancy() const;
+    double get_fragmentation() const;
+
+private:
+    mutable CLock _lock;
+    CSlabMemPool _slab_mem_pool;
+};
+
+/***
+  * 竞技场（Arena）分配器，非线程安全
+  * 从大块内存中顺序切分（bump），只能一次性全部释放，
+  * 适用于单个请求处理过程中的临时内存，请求结束调用reset即可
+  */
+class CArena
+{
+public:
+    /***
+      * @block_size: 每次向堆申请的块大小
+      */
+    CArena(size_t block_size=SIZE_16K);
+    ~CArena();
+
+    /***
+      * 分配内存
+      * @size: 需要的字节数，超过块大小的单独申请一块
+      * @alignment: 对齐字节数，须为2的幂
+      */
+    void* allocate(size_t size, size_t alignment=sizeof(void*));
+
+    /** 复制一个字符串到Arena中 */
+    char* strdup(const char* str, size_t length);
+
+    /***
+      * 释放所有已分配的内存
+      * 保留第一块以便复用，其它块归还给堆
+      */
+    void reset();
+
+    /** 得到已分配的字节数（不含对齐的浪费） */
+    size_t get_allocated_bytes() const { return _allocated_bytes; }
+
+    /** 得到当前持有的块的总字节数 */
+    size_t get_reserved_bytes() const { return _reserved_bytes; }
+
+    /** 得到当前持有的块数 */
+    size_t get_block_number() const { return _blocks.size(); }
+
+private:
+    CArena(const CArena&);
+    CArena& operator =(const CArena&);
+    char* new_block(size_t size);
+
+private:
+    size_t _block_size;
+    char* _current;   /** 当前块中下一个可分配的位置 */
+    char* _end;       /** 当前块的结尾 */
+    size_t _allocated_bytes;
+    size_t _reserved_bytes;
+    std::vector<std::pair<char*, size_t> > _blocks;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_SLAB_MEM_POOL_H
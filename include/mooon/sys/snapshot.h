@@ -0,0 +1,200 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_SNAPSHOT_H
+#define MOOON_SYS_SNAPSHOT_H
+#include "mooon/sys/mmap.h"
+#include <map>
+#include <string>
+#include <string_view>
+SYS_NAMESPACE_BEGIN
+
+/** 快照数据的写入，整数为本机字节序，快照只在同一台机器的新旧进程间传递 */
+class CSnapshotWriter
+{
+public:
+    void write_uint32(uint32_t value) { write(&value, sizeof(value)); }
+    void write_uint64(uint64_t value) { write(&value, sizeof(value)); }
+
+    /** 写入4字节的长度和数据 */
+    void write_string(std::string_view value);
+    void write(const void* data, size_t size) { _data.append(static_cast<const char*>(data), size); }
+
+    const std::string& get_data() const { return _data; }
+
+private:
+    std::string _data;
+};
+
+/** 快照数据的读取，各read在数据不足时返回false，之后的读取都返回false */
+class CSnapshotReader
+{
+public:
+    /***
+      * @elapsed_milliseconds: 快照保存后经过的毫秒数，按墙上时间计，
+      *                        组件恢复带TTL的数据时应从剩余的TTL中扣除
+      */
+    CSnapshotReader(const char* data, size_t size, uint64_t elapsed_milliseconds=0)
+        : _data(data), _size(size), _offset(0), _elapsed_milliseconds(elapsed_milliseconds)
+    {
+    }
+
+    bool read_uint32(uint32_t* value) { return read(value, sizeof(*value)); }
+    bool read_uint64(uint64_t* value) { return read(value, sizeof(*value)); }
+    bool read_string(std::string* value);
+    bool read(void* data, size_t size);
+
+    /** 数据是否已读完 */
+    bool eof() const { return _offset >= _size; }
+
+    uint64_t get_elapsed_milliseconds() const { return _elapsed_milliseconds; }
+
+private:
+    const char* _data;
+    size_t _size;
+    size_t _offset;
+    uint64_t _elapsed_milliseconds;
+};
+
+/***
+  * 可保存到快照的组件（缓存、一致性哈希环等），见CSnapshotManager
+  */
+class ISnapshotable
+{
+public:
+    virtual ~ISnapshotable() {}
+
+    /** 保存状态，组件可能同时在被其它线程使用，须自己加锁 */
+    virtual void save_snapshot(CSnapshotWriter* writer) = 0;
+
+    /***
+      * 从快照恢复状态
+      * @return: 数据不完整或不合法时返回false，这时组件应保证自己仍可用（如清空或保留已恢复的部分）
+      */
+    virtual bool load_snapshot(CSnapshotReader* reader) = 0;
+};
+
+/** 快照的读写函数，CCacheSnapshot等以它们读写键和值，其它类型在其名字空间中重载即可 */
+inline void snapshot_write(CSnapshotWriter* writer, uint32_t value) { writer->write_uint32(value); }
+inline void snapshot_write(CSnapshotWriter* writer, int32_t value) { writer->write_uint32(static_cast<uint32_t>(value)); }
+inline void snapshot_write(CSnapshotWriter* writer, uint64_t value) { writer->write_uint64(value); }
+inline void snapshot_write(CSnapshotWriter* writer, int64_t value) { writer->write_uint64(static_cast<uint64_t>(value)); }
+inline void snapshot_write(CSnapshotWriter* writer, const std::string& value) { writer->write_string(value); }
+inline bool snapshot_read(CSnapshotReader* reader, uint32_t* value) { return reader->read_uint32(value); }
+inline bool snapshot_read(CSnapshotReader* reader, int32_t* value) { return reader->read(value, sizeof(*value)); }
+inline bool snapshot_read(CSnapshotReader* reader, uint64_t* value) { return reader->read_uint64(value); }
+inline bool snapshot_read(CSnapshotReader* reader, int64_t* value) { return reader->read(value, sizeof(*value)); }
+inline bool snapshot_read(CSnapshotReader* reader, std::string* value) { return reader->read_string(value); }
+
+/***
+  * 快照管理：重启时将内存中的状态（缓存等）交给新进程，新进程不必冷启动，
+  * 避免每次发布后缓存命中率骤降和对MySQL、Redis等的集中回源。
+  *
+  * 旧进程以save_to_memfd（平滑重启时经SCM_RIGHTS交给新进程）或save_to_file（正常退出时）
+  * 保存所有登记的组件，新进程以adopt或adopt_file采用快照，之后register_component
+  * 登记组件时，快照中有同名的段即立即恢复。快照中每个段有名字、版本和CRC32C：
+  * 版本不同（数据格式变了）或校验失败的段被丢弃，对应的组件冷启动，不影响其它段。
+  * CMainHelper已集成，见CMainHelper::register_snapshot。
+  *
+  * 格式（本机字节序）：
+  * 1) 头部：魔数“MOOONSS1”、版本、段数、保存时的墙上时间（毫秒）和快照大小
+  * 2) 段：名字长度、组件版本、数据长度、CRC32C（名字和数据的），之后为名字和数据，按8字节对齐
+  *
+  * 非线程安全，通常只在初始化和退出时使用。
+  */
+class CSnapshotManager
+{
+public:
+    CSnapshotManager();
+    ~CSnapshotManager();
+
+    /***
+      * 登记组件，已采用的快照中有同名、同版本且校验通过的段时，立即调用组件的load_snapshot
+      * @version: 组件数据格式的版本，格式变化时应加一，使新进程丢弃旧格式的数据
+      * @return: 从快照恢复了状态时返回true
+      */
+    bool register_component(const std::string& name, ISnapshotable* component, uint32_t version=1);
+    void unregister_component(const std::string& name);
+
+    uint32_t get_component_number() const { return static_cast<uint32_t>(_components.size()); }
+
+    /** 保存所有登记的组件，追加到snapshot中 */
+    void save(std::string* snapshot) const;
+
+    /***
+      * 保存到memfd，返回的fd由调用者关闭
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    int save_to_memfd() const;
+
+    /***
+      * 保存到文件，先写到“文件名.tmp”再改名
+      * @exception: 出错时抛出CSyscallException异常
+      */
+    void save_to_file(const std::string& filepath) const;
+
+    /***
+      * 采用fd中的快照（由save_to_memfd保存），fd在返回时已被关闭
+      * @return: 快照不合法时返回false
+      */
+    bool adopt(int fd);
+
+    /***
+      * 采用文件中的快照，采用后文件被删除，以免之后（如崩溃后重启）再次采用过时的状态
+      * @return: 文件不存在或不合法时返回false
+      */
+    bool adopt_file(const std::string& filepath);
+
+    /***
+      * 丢弃采用的快照，通常在所有组件登记完后调用
+      * @return: 没有被组件认领的段数
+      */
+    uint32_t release();
+
+    bool has_snapshot() const { return _snapshot != NULL; }
+
+private:
+    CSnapshotManager(const CSnapshotManager&);
+    CSnapshotManager& operator =(const CSnapshotManager&);
+
+    // 校验头部并登记各段
+    bool adopt_mapped(mmap_t* ptr);
+
+private:
+    struct Component
+    {
+        ISnapshotable* component;
+        uint32_t version;
+    };
+
+    struct Section
+    {
+        uint32_t version;
+        uint32_t checksum;
+        const char* data;
+        size_t size;
+    };
+
+    std::map<std::string, struct Component> _components;
+    mmap_t* _snapshot;                               // 采用的快照
+    uint64_t _elapsed_milliseconds;                  // 快照保存后经过的毫秒数
+    std::map<std::string, struct Section> _sections; // 未被认领的段
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_SNAPSHOT_H
@@ -0,0 +1,183 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_SPIN_LOCK_H
+#define MOOON_SYS_SPIN_LOCK_H
+#include "mooon/sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+// 自旋等待时让出流水线，降低功耗和对另一个超线程的影响
+#if defined(__i386__) || defined(__x86_64__)
+#define SPIN_LOCK_PAUSE() __builtin_ia32_pause()
+#else
+#define SPIN_LOCK_PAUSE() __asm__ __volatile__("" ::: "memory")
+#endif
+
+/***
+  * 适用于非常短的临界区的锁，和CLock有相同的lock/unlock/try_lock接口，
+  * 因此可以用于LockHelper<LockClass>及以锁类型为模板参数的类，
+  * 但不能和CEvent一起使用（CEvent只支持CLock）。
+  *
+  * 可选的竞争统计在加锁成功后、临界区内更新，不需要原子操作，
+  * 读取到的是近似值，用于判断哪些锁竞争激烈，值得换成本类锁或拆分。
+  */
+
+/***
+  * 自适应锁，基于futex实现：
+  * 没有竞争时加锁和解锁都只是一次原子操作，不进入内核；
+  * 有竞争时先自旋一定次数，仍得不到锁才在futex上睡眠，
+  * 单CPU时不自旋。不支持递归加锁。
+  */
+class CAdaptiveLock
+{
+public:
+    /***
+      * @spin_number: 进入睡眠前的最多自旋次数
+      * @enable_stat: 是否开启竞争统计
+      */
+    CAdaptiveLock(uint32_t spin_number=100, bool enable_stat=false);
+
+    /** 加锁，如果不能获取到锁，则一直等待到获取到锁为止 */
+    void lock()
+    {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&_state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            if (_enable_stat)
+                ++_lock_number;
+        }
+        else
+        {
+            lock_slow();
+        }
+    }
+
+    /** 解锁，请注意必须已经调用了lock加锁，才能调用unlock解锁 */
+    void unlock()
+    {
+        // 状态为2表示可能有线程在睡眠，需唤醒一个
+        if (__atomic_exchange_n(&_state, 0, __ATOMIC_RELEASE) == 2)
+            wake();
+    }
+
+    /***
+      * 尝试性的去获取锁，如果得不到锁，则立即返回
+      * @return: 如果获取到了锁，则返回true，否则返回false
+      */
+    bool try_lock()
+    {
+        int expected = 0;
+        if (!__atomic_compare_exchange_n(&_state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return false;
+
+        if (_enable_stat)
+            ++_lock_number;
+        return true;
+    }
+
+    /** 得到加锁次数，未开启统计时总是为0 */
+    uint64_t get_lock_number() const { return _lock_number; }
+
+    /** 得到加锁时遇到竞争（锁已被持有）的次数 */
+    uint64_t get_contention_number() const { return _contention_number; }
+
+    /** 得到加锁时进入睡眠的次数，远小于竞争次数时说明自旋是有效的 */
+    uint64_t get_sleep_number() const { return _sleep_number; }
+
+private:
+    void lock_slow();
+    void wake();
+
+private:
+    int _state; /** 0: 未加锁，1: 已加锁，2: 已加锁且可能有等待者 */
+    uint32_t _spin_number;
+    bool _enable_stat;
+    uint64_t _lock_number;
+    uint64_t _contention_number;
+    uint64_t _sleep_number;
+};
+
+/***
+  * 排队自旋锁（ticket lock），按申请的先后顺序获得锁，不会出现饥饿，
+  * 等待时一直自旋（长时间得不到锁时让出CPU），
+  * 因此只适用于线程数不超过CPU数、且临界区极短的场景。不支持递归加锁。
+  */
+class CTicketLock
+{
+public:
+    /***
+      * @enable_stat: 是否开启竞争统计
+      */
+    CTicketLock(bool enable_stat=false);
+
+    /** 加锁，如果不能获取到锁，则一直等待到获取到锁为止 */
+    void lock()
+    {
+        const uint32_t ticket = __atomic_fetch_add(&_next_ticket, 1, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&_now_serving, __ATOMIC_ACQUIRE) != ticket)
+        {
+            wait(ticket);
+        }
+        else if (_enable_stat)
+        {
+            ++_lock_number;
+        }
+    }
+
+    /** 解锁，请注意必须已经调用了lock加锁，才能调用unlock解锁 */
+    void unlock()
+    {
+        // 只有持有者修改_now_serving，不需要原子加
+        __atomic_store_n(&_now_serving, __atomic_load_n(&_now_serving, __ATOMIC_RELAXED)+1, __ATOMIC_RELEASE);
+    }
+
+    /***
+      * 尝试性的去获取锁，如果得不到锁（包括有其它线程在排队），则立即返回
+      * @return: 如果获取到了锁，则返回true，否则返回false
+      */
+    bool try_lock()
+    {
+        uint32_t ticket = __atomic_load_n(&_now_serving, __ATOMIC_RELAXED);
+        if (!__atomic_compare_exchange_n(&_next_ticket, &ticket, ticket+1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return false;
+
+        if (_enable_stat)
+            ++_lock_number;
+        return true;
+    }
+
+    /** 得到加锁次数，未开启统计时总是为0 */
+    uint64_t get_lock_number() const { return _lock_number; }
+
+    /** 得到加锁时需要排队的次数 */
+    uint64_t get_contention_number() const { return _contention_number; }
+
+private:
+    void wait(uint32_t ticket);
+
+private:
+    uint32_t _next_ticket;  /** 下一个申请者得到的号 */
+    uint32_t _now_serving;  /** 当前持有锁的号 */
+    uint32_t _yield_spins;  /** 自旋多少次后开始让出CPU */
+    bool _enable_stat;
+    uint64_t _lock_number;
+    uint64_t _contention_number;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_SPIN_LOCK_H
@@ -20,6 +20,8 @@
 #define MOOON_SYS_SQLITE3_DB_H
 #include "mooon/sys/simple_db.h"
 #include "mooon/utils/object.h"
+#include <list>
+#include <map>
 #include <stdarg.h>
 
 // SQLite3安装后的include目录结构不标准，需要手动调整成：
@@ -31,6 +33,13 @@ SYS_NAMESPACE_BEGIN
 
 /**
  * SQLite3版本的DB连接
+ *
+ * 1) open时按设置执行journal_mode、synchronous、mmap_size和busy_timeout等PRAGMA，
+ *    写多的场合推荐WAL加NORMAL，每次提交不再fsync数据库文件，只在检查点时同步
+ * 2) query、update和execute的语句按SQL文本缓存在连接中（LRU），
+ *    同一SQL再次执行时不再解析，因此应尽量以execute带参数执行，而不是把值格式化进SQL
+ * 3) 默认每条update为一个事务，各自提交一次，
+ *    批量写时以enable_autocommit(false)或CSQLite3BatchWriter将多条合并到一个事务
  */
 class CSQLite3Connection: public CDBConnectionBase
 {
@@ -38,6 +47,22 @@ public:
     CSQLite3Connection(size_t sql_max=8192);
     ~CSQLite3Connection();
 
+public: // 以下须在open之前设置
+    // 日志模式，如“WAL”、“DELETE”，为空（默认）表示不设置
+    void set_journal_mode(const std::string& journal_mode) { _journal_mode = journal_mode; }
+
+    // 同步级别，如“NORMAL”、“FULL”、“OFF”，为空（默认）表示不设置
+    void set_synchronous(const std::string& synchronous) { _synchronous = synchronous; }
+
+    // 内存映射读的字节数，为0时不使用mmap，为负值（默认）表示不设置
+    void set_mmap_size(int64_t mmap_size) { _mmap_size = mmap_size; }
+
+    // 数据库被其它连接锁住时的等待毫秒数，默认为0即立即返回SQLITE_BUSY
+    void set_busy_timeout(int milliseconds) { _busy_timeout_milliseconds = milliseconds; }
+
+    // 语句缓存的最大个数，为0时不缓存，默认为64
+    void set_statement_cache_size(uint32_t cache_size) { _statement_cache_size = cache_size; }
+
 public:
     virtual void open();
     virtual void close() throw ();
@@ -46,14 +71,101 @@ public:
     virtual uint64_t update(const char* format, ...) __attribute__((format(printf, 2, 3)));
     virtual std::string str() throw ();
 
+    // 以下事务操作以BEGIN、COMMIT和ROLLBACK实现，
+    // enable_autocommit(false)后开始一个事务，commit或rollback后自动开始下一个，
+    // enable_autocommit(true)时提交进行中的事务
+    virtual void commit();
+    virtual void rollback();
+    virtual void enable_autocommit(bool enabled);
+
+    /***
+      * 执行以“?”为参数占位符的单条语句，参数以文本绑定（由SQLite按列的类型亲和性转换），不需要转义，
+      * 语句被缓存，适合反复执行的写入
+      * @return: 影响的行数
+      * @exception: 出错抛出CDBException异常
+      */
+    uint64_t execute(const std::string& sql, const DBRow& params=DBRow());
+
+    /** 是否处于enable_autocommit(false)开始的事务中 */
+    bool in_transaction() const { return !_autocommit; }
+
+    /** 当前缓存的语句个数 */
+    uint32_t get_statement_number() const { return static_cast<uint32_t>(_statements.size()); }
+
 private:
     virtual void do_query(DBTable& db_table, const char* sql, int sql_length);
 
+    // 以sqlite3_prepare_v2和sqlite3_step逐行读取，不像sqlite3_get_table读入整个结果集
+    virtual DBCursor* do_open_cursor(const char* sql, int sql_length);
+
 private:
+    typedef std::list<std::pair<std::string, void*> > statement_list_t;
+
     void do_open();
+    void exec(const char* sql);
+    void pragma(const char* name, const std::string& value);
+
+    // 取得sql的语句，cached返回是否来自或放入了缓存，
+    // 多条语句的sql（tail不为空）返回NULL，由调用者改用sqlite3_exec
+    void* prepare(const char* sql, int sql_length, bool* cached);
+    void clear_statements();
 
 private:
     void* _sqlite;
+    bool _autocommit;
+    std::string _journal_mode;
+    std::string _synchronous;
+    int64_t _mmap_size;
+    int _busy_timeout_milliseconds;
+    uint32_t _statement_cache_size;
+    statement_list_t _statements;                                // 最近使用的在前
+    std::map<std::string, statement_list_t::iterator> _statement_index;
+};
+
+/***
+  * 将多条写入合并到一个事务中提交，大幅减少fsync次数（每个事务一次），
+  * 每max_updates条提交一次，析构时提交剩余的，
+  * 使用期间连接不能再用于其它的事务。
+  *
+  * 使用示例：
+  * CSQLite3BatchWriter writer(&sqlite, 1000);
+  * DBRow params(2);
+  * for (...)
+  * {
+  *     params[0] = key;
+  *     params[1] = value;
+  *     writer.execute("INSERT OR REPLACE INTO meta (k,v) VALUES (?,?)", params);
+  * }
+  * writer.flush();
+  */
+class CSQLite3BatchWriter
+{
+public:
+    CSQLite3BatchWriter(CSQLite3Connection* sqlite, uint32_t max_updates=1000);
+
+    /** 提交剩余的，出错时回滚，不抛出异常 */
+    ~CSQLite3BatchWriter();
+
+    /***
+      * 在当前事务中执行，攒满max_updates条后提交
+      * @exception: 出错抛出CDBException异常，当前事务已回滚（之前已提交的不受影响）
+      */
+    uint64_t execute(const std::string& sql, const DBRow& params=DBRow());
+
+    /** 提交当前事务 */
+    void flush();
+
+    /** 当前事务中还未提交的条数 */
+    uint32_t get_pending_number() const { return _pending_number; }
+
+    /** 已提交的事务个数 */
+    uint64_t get_commit_number() const { return _commit_number; }
+
+private:
+    CSQLite3Connection* _sqlite;
+    const uint32_t _max_updates;
+    uint32_t _pending_number;
+    uint64_t _commit_number;
 };
 
 SYS_NAMESPACE_END
@@ -0,0 +1,168 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_STARTUP_H
+#define MOOON_SYS_STARTUP_H
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/utils/bind.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/** 启动的一个阶段，时间为相对于CStartupProfiler创建时的毫秒数 */
+typedef struct
+{
+    std::string name;
+    uint64_t start_milliseconds;
+    uint64_t duration_milliseconds;
+}startup_phase_t;
+
+/***
+  * 启动阶段的计时，用于找出进程启动慢在哪里（参数解析、创建日志器、连接ZooKeeper和DB、加载缓存等），
+  * CMainHelper在init结束时记录各阶段的耗时（见CMainHelper::get_startup_profiler）。
+  * 是线程安全的，CParallelInitializer并行执行的任务也记录到同一个CStartupProfiler中。
+  *
+  * 使用示例：
+  * {
+  *     CStartupPhase phase(profiler, "load_cache");
+  *     load_cache();
+  * }
+  * MYLOG_INFO("%s\n", profiler->to_string().c_str());
+  */
+class CStartupProfiler
+{
+public:
+    CStartupProfiler();
+
+    /** 记录一个阶段，start_milliseconds和end_milliseconds为CClock::get_milliseconds的值 */
+    void add_phase(const std::string& name, uint64_t start_milliseconds, uint64_t end_milliseconds);
+
+    /** 所有阶段，按开始时间排序 */
+    std::vector<startup_phase_t> get_phases() const;
+
+    /** 从创建到现在的毫秒数 */
+    uint64_t get_elapsed_milliseconds() const;
+
+    /***
+      * 如“total 2350ms: parse_arguments 0ms, create_logger 2ms, on_init 2340ms@8, init.db 1200ms@10”，
+      * @后为开始时的毫秒数，按耗时从大到小排列，耗时为0的阶段也列出
+      */
+    std::string to_string() const;
+
+private:
+    mutable CLock _lock;
+    const uint64_t _start_milliseconds;
+    std::vector<startup_phase_t> _phases;
+};
+
+/** 以作用域计时一个启动阶段，profiler为NULL时不计时 */
+class CStartupPhase
+{
+public:
+    CStartupPhase(CStartupProfiler* profiler, const std::string& name);
+    ~CStartupPhase();
+
+private:
+    CStartupProfiler* _profiler;
+    std::string _name;
+    uint64_t _start_milliseconds;
+};
+
+/***
+  * 按依赖关系并行执行初始化任务，相互独立的任务（如创建DB连接池、连接ZooKeeper、创建Kafka生产者）
+  * 同时执行，启动时间由最长的依赖链决定，而不是所有任务耗时之和：
+  * 1) 任务返回false或抛出CException时初始化失败，不再启动新的任务，已在执行的任务执行完后run返回false
+  * 2) 依赖的任务不存在或有循环依赖时，run不执行任何任务，抛出CException异常
+  * 3) 调用run的线程也执行任务，每个任务在执行它的线程中完成，任务之间若共享数据须自己加锁
+  *
+  * 使用示例（在CMainHelper::on_init中）：
+  * mooon::sys::CParallelInitializer initializer;
+  * initializer.add_task("zookeeper", mooon::utils::bind<bool>(&CMyMainHelper::init_zookeeper, this));
+  * initializer.add_task("db", mooon::utils::bind<bool>(&CMyMainHelper::init_db, this));
+  * initializer.add_task("cache", mooon::utils::bind<bool>(&CMyMainHelper::load_cache, this), "db,zookeeper");
+  * return initializer.run(0, get_startup_profiler());
+  */
+class CParallelInitializer
+{
+public:
+    CParallelInitializer();
+    ~CParallelInitializer();
+
+    /***
+      * 添加任务，须在run之前调用
+      * @name: 任务名，在CStartupProfiler中记为“init.任务名”
+      * @task: 由utils::bind得到的任务，返回false表示失败
+      * @dependencies: 以逗号分隔的依赖的任务名，这些任务都成功后才执行该任务
+      * @exception: 任务名为空或重复时抛出CException异常
+      */
+    void add_task(const std::string& name, utils::Functor<bool> task, const std::string& dependencies=std::string(""));
+
+    /***
+      * 执行所有任务，所有任务都成功才返回true
+      * @thread_number: 并行执行的线程数（包括调用者线程），为0时每个任务一个线程
+      * @profiler: 不为NULL时记录每个任务的耗时
+      * @exception: 依赖的任务不存在或有循环依赖时抛出CException异常，
+      *             创建线程失败时抛出CSyscallException异常
+      */
+    bool run(uint16_t thread_number=0, CStartupProfiler* profiler=NULL);
+
+    /** 失败的任务名及原因，run返回false后可用 */
+    const std::string& get_error() const { return _error; }
+
+    /** 决定总耗时的依赖链，如“db -> cache”，run返回true后可用 */
+    std::string get_critical_path() const;
+
+    uint32_t get_task_number() const { return static_cast<uint32_t>(_tasks.size()); }
+
+private:
+    struct Task
+    {
+        std::string name;
+        utils::Functor<bool> function;
+        std::vector<std::string> dependency_names;
+        std::vector<Task*> dependents;  // 依赖该任务的任务
+        uint32_t pending_number;        // 未完成的依赖数
+        uint64_t finish_milliseconds;
+        Task* critical_dependency;      // 最后完成的依赖
+    };
+
+private:
+    CParallelInitializer(const CParallelInitializer&);
+    CParallelInitializer& operator =(const CParallelInitializer&);
+
+    void resolve_dependencies();
+    void work();
+    bool execute(Task* task, std::string* errmsg);
+
+private:
+    std::vector<Task*> _tasks;
+    std::string _error;
+    CStartupProfiler* _profiler;
+
+private:
+    CLock _lock;
+    CEvent _event;                // 有任务完成
+    std::vector<Task*> _ready_tasks;
+    uint32_t _running_number;
+    uint32_t _finished_number;
+    bool _failed;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_STARTUP_H
@@ -0,0 +1,143 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_STATIC_HASH_TABLE_H
+#define MOOON_SYS_STATIC_HASH_TABLE_H
+#include "mooon/sys/mmap.h"
+#include <string>
+#include <string_view>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/** 静态哈希表的一个槽 */
+typedef struct
+{
+    uint64_t record_offset; /** 记录在哈希表中的偏移，0表示空槽 */
+    uint32_t fingerprint;   /** 键哈希的高32位 */
+    uint32_t key_size;
+}static_hash_slot_t;
+
+/***
+  * 只读的静态哈希表文件（类似CDB），用于代替启动时将大的静态词典（IP地理库、关键词表等）
+  * 逐行解析到std::map：由static_hash_maker或CStaticHashTableWriter离线生成，
+  * 运行时以mmap打开，打开时只校验头部，不解析、不复制，因此打开只需几毫秒，
+  * 且同一文件的页通过页缓存在所有进程间共享，不再每个进程一份私有的副本。
+  *
+  * 以完美哈希（hash and displace）定位，每次查找最多访问三处：桶的位移、槽和记录，
+  * 键不存在时一般只访问前两处（槽中有键哈希的指纹）。
+  *
+  * 格式（本机字节序，头部、位移和槽按8字节对齐）：
+  * 1) 头部：魔数“MOOONHT1”、版本、哈希种子、键数、桶数、槽数、记录区偏移和文件大小
+  * 2) 位移：每个桶一个uint32_t，键先按哈希值分到桶，同一个桶中的键用该桶的位移求得各自的槽
+  * 3) 槽：每个槽为记录的偏移（0表示空槽）、键哈希的指纹和键的长度，槽数略多于键数
+  * 4) 记录区：每条记录为键长度、值长度（均为uint32_t）、键和值
+  */
+class CStaticHashTable
+{
+public:
+    CStaticHashTable();
+    ~CStaticHashTable();
+
+    /***
+      * 打开内存中的哈希表，不复制，data在close之前须一直有效，须按8字节对齐
+      * @exception: 格式不对时抛出utils::CException异常
+      */
+    void open(const void* data, size_t size);
+
+    /***
+      * 以只读的共享映射打开哈希表文件，之前打开的先被关闭
+      * @populate: 为true时打开即读入所有页（MAP_POPULATE），之后查找不再缺页，
+      *            否则按需缺页，且不预读（MADV_RANDOM），适合只访问小部分的大文件
+      * @exception: 格式不对时抛出utils::CException异常，打开或映射文件出错时抛出CSyscallException异常
+      */
+    void open_file(const std::string& filepath, bool populate=false);
+
+    /** 关闭，之前find得到的视图不再有效 */
+    void close();
+
+    bool is_open() const { return _table != NULL; }
+
+    /** 键数 */
+    uint64_t get_key_number() const { return _key_number; }
+
+    /** 哈希表的字节数 */
+    size_t get_size() const { return _size; }
+
+    /***
+      * 查找键，打开后可多线程并发调用
+      * @value: 输出参数，值的视图，指向映射区，在close之前有效，可为NULL
+      * @return: 键不存在时返回false
+      * @exception: 记录的偏移越界（文件损坏）时抛出utils::CException异常
+      */
+    bool find(std::string_view key, std::string_view* value) const;
+
+private:
+    CStaticHashTable(const CStaticHashTable&);
+    CStaticHashTable& operator =(const CStaticHashTable&);
+
+private:
+    const char* _table;
+    size_t _size;
+    uint64_t _seed;
+    uint64_t _key_number;
+    uint64_t _bucket_number;
+    uint64_t _slot_number;
+    const uint32_t* _pilots;
+    const static_hash_slot_t* _slots;
+    mmap_t* _mmap; // open_file时的映射
+};
+
+/***
+  * 静态哈希表的生成器，键和值先全部放在内存中，write_file时求完美哈希并写文件
+  *
+  * 使用示例：
+  * mooon::sys::CStaticHashTableWriter writer;
+  * writer.add("1.0.1.0", "CN|Fujian");
+  * writer.write_file("ip_geo.sht");
+  */
+class CStaticHashTableWriter
+{
+public:
+    CStaticHashTableWriter();
+
+    /** 增加一个键值，键不能重复（write_file时检查） */
+    void add(std::string_view key, std::string_view value);
+
+    uint64_t get_key_number() const { return static_cast<uint64_t>(_records.size()); }
+
+    /***
+      * 生成哈希表并写到文件，先写到“文件名.tmp”再改名，
+      * 因此已打开旧文件的进程不受影响（仍映射着旧的），重新打开即得到新的
+      * @exception: 键重复时抛出utils::CException异常，写文件出错时抛出CSyscallException异常
+      */
+    void write_file(const std::string& filepath) const;
+
+private:
+    struct Record
+    {
+        uint64_t offset; // 在_data中的偏移
+        uint32_t key_size;
+        uint32_t value_size;
+    };
+
+    std::string _data; // 所有的键和值
+    std::vector<struct Record> _records;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_STATIC_HASH_TABLE_H
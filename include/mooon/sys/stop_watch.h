@@ -2,11 +2,14 @@
 // 秒表用于计时
 #ifndef MOOON_SYS_STOP_WATCH_H
 #define MOOON_SYS_STOP_WATCH_H
+#include "mooon/sys/clock.h"
 #include "mooon/sys/config.h"
 #include <sys/time.h>
+#include <time.h>
 SYS_NAMESPACE_BEGIN
 
 // 计时器
+// 基于单调时钟CClock，不受NTP和修改系统时间的影响
 class CStopWatch
 {
 public:
@@ -14,53 +17,63 @@ public:
     {
         restart();
 
-        _stop_time.tv_sec = 0;
-        _stop_time.tv_usec = 0;
-        _total_time.tv_sec = _start_time.tv_sec;
-        _total_time.tv_usec = _start_time.tv_usec;
+        _stop_nanoseconds = 0;
+        _total_nanoseconds = _start_nanoseconds;
+        _start_seconds = time(NULL);
     }
 
     // 重新开始计时
     void restart()
     {
-        (void)gettimeofday(&_start_time, NULL);
+        _start_nanoseconds = CClock::get_nanoseconds();
     }
 
-    // 返回微秒级的耗时
+    // 返回纳秒级的耗时
     // restart 调用之后是否重新开始计时
-    uint64_t get_elapsed_microseconds(bool restart=true)
+    uint64_t get_elapsed_nanoseconds(bool restart=true)
     {
-        (void)gettimeofday(&_stop_time, NULL);
-        const uint64_t elapsed_microseconds = static_cast<uint64_t>((_stop_time.tv_sec - _start_time.tv_sec) * (__UINT64_C(1000000)) + (_stop_time.tv_usec - _start_time.tv_usec));
+        _stop_nanoseconds = CClock::get_nanoseconds();
+        const uint64_t elapsed_nanoseconds = _stop_nanoseconds - _start_nanoseconds;
 
         // 重计时
         if (restart)
         {
-            _start_time.tv_sec = _stop_time.tv_sec;
-            _start_time.tv_usec = _stop_time.tv_usec;
+            _start_nanoseconds = _stop_nanoseconds;
         }
 
-        return elapsed_microseconds;
+        return elapsed_nanoseconds;
+    }
+
+    // 返回微秒级的耗时
+    // restart 调用之后是否重新开始计时
+    uint64_t get_elapsed_microseconds(bool restart=true)
+    {
+        return get_elapsed_nanoseconds(restart) / 1000;
+    }
+
+    uint64_t get_total_elapsed_nanoseconds()
+    {
+        _stop_nanoseconds = CClock::get_nanoseconds();
+        return _stop_nanoseconds - _total_nanoseconds;
     }
 
     uint64_t get_total_elapsed_microseconds()
     {
-        (void)gettimeofday(&_stop_time, NULL);
-        const uint64_t total_elapsed_microseconds = static_cast<uint64_t>((_stop_time.tv_sec - _total_time.tv_sec) * (__UINT64_C(1000000)) + (_stop_time.tv_usec - _total_time.tv_usec));
-        return total_elapsed_microseconds;
+        return get_total_elapsed_nanoseconds() / 1000;
     }
 
     // 相当于time(NULL)
     // 得到构造时系统的当前时间
     time_t get_start_seconds() const
     {
-        return _total_time.tv_sec;
+        return _start_seconds;
     }
 
 private:
-    struct timeval _total_time;
-    struct timeval _start_time;
-    struct timeval _stop_time;
+    uint64_t _total_nanoseconds;
+    uint64_t _start_nanoseconds;
+    uint64_t _stop_nanoseconds;
+    time_t _start_seconds;
 };
 
 SYS_NAMESPACE_END
@@ -0,0 +1,161 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_STRING_INTERNER_H
+#define MOOON_SYS_STRING_INTERNER_H
+#include "mooon/sys/lock.h"
+#include "mooon/sys/slab_mem_pool.h"
+#include "mooon/utils/flat_hash_map.h"
+#include <functional>
+#include <string>
+#include <string_view>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 驻留的字符串（由CStringInterner::intern得到），只是一个指针：
+  * 复制、相等比较和取哈希值都是O(1)的，同一CStringInterner中内容相同的字符串为同一个对象，
+  * 字符串存在CStringInterner的Arena中，在CStringInterner销毁前一直有效（get_singleton的从不销毁），
+  * 默认构造的为空串，所有CStringInterner的空串都相同
+  */
+class CInternedString
+{
+public:
+    CInternedString();
+
+    /** 在CStringInterner中的ID，从0开始连续分配，0为空串，可用作数组下标或写入二进制日志 */
+    uint32_t id() const { return _entry->id; }
+
+    /** 内容的哈希值，在intern时计算 */
+    uint64_t hash() const { return _entry->hash; }
+
+    /** 以'\0'结尾 */
+    const char* c_str() const { return _entry->str; }
+    size_t size() const { return _entry->size; }
+    bool empty() const { return 0 == _entry->size; }
+    std::string_view view() const { return std::string_view(_entry->str, _entry->size); }
+    std::string str() const { return std::string(_entry->str, _entry->size); }
+
+    bool operator ==(const CInternedString& other) const { return _entry == other._entry; }
+    bool operator !=(const CInternedString& other) const { return _entry != other._entry; }
+
+    /** 按地址比较，顺序没有意义，只用于作为std::map等的键 */
+    bool operator <(const CInternedString& other) const { return _entry < other._entry; }
+
+private:
+    friend class CStringInterner;
+    struct Entry
+    {
+        uint64_t hash;
+        uint32_t id;
+        uint32_t size;
+        char str[8]; // 实际长度为size+1
+    };
+
+    explicit CInternedString(const Entry* entry): _entry(entry) {}
+
+private:
+    static const Entry _empty_entry; // 0号的空串，所有CStringInterner共用
+    const Entry* _entry;
+};
+
+/***
+  * 字符串驻留表，用于反复出现的标识符：日志的模块名、度量名、Redis键前缀和HBase列名等，
+  * 驻留后以CInternedString代替std::string传递和比较，不再有分配和逐字节比较，
+  * 如CMetricsRegistry::get_counter(const CInternedString&)以指针查找。
+  * 线程安全，按哈希值分成多个分片，每个分片有自己的锁、Arena和哈希表，
+  * 字符串不会被删除，不要驻留无限增长的内容（如每个请求的rowkey）。
+  *
+  * 使用示例：
+  * static const mooon::sys::CInternedString name = mooon::sys::CStringInterner::get_singleton()->intern("db.query");
+  * CCounter* counter = CMetricsRegistry::get_singleton()->get_counter(name);
+  */
+class CStringInterner
+{
+public:
+    static CStringInterner* get_singleton();
+
+    CStringInterner();
+    ~CStringInterner();
+
+    /***
+      * 驻留字符串，已存在时返回已有的
+      * @exception: 个数超过STRING_MAX时抛出CException异常
+      */
+    CInternedString intern(std::string_view str);
+
+    /** 查找已驻留的字符串，不存在时返回false，不会驻留 */
+    bool find(std::string_view str, CInternedString* interned) const;
+
+    /** 由ID得到驻留的字符串，不加锁，ID不存在时返回空串 */
+    CInternedString get(uint32_t id) const;
+
+    /** 驻留的个数，包括0号的空串，即下一个ID */
+    uint32_t size() const;
+
+    /** 字符串占用的Arena字节数 */
+    size_t get_allocated_bytes() const;
+
+public:
+    enum
+    {
+        SHARD_NUMBER = 16,            /** 分片数，须为2的幂 */
+        CHUNK_BITS = 12,              /** ID表每块4096项，已分配的块不会移动 */
+        CHUNK_NUMBER = 4096,
+        STRING_MAX = CHUNK_NUMBER << CHUNK_BITS
+    };
+
+private:
+    CStringInterner(const CStringInterner&);
+    CStringInterner& operator =(const CStringInterner&);
+
+    // 以string_view为键，指向Arena中的字符串
+    typedef utils::CFlatHashMap<std::string_view, const CInternedString::Entry*> EntryTable;
+
+    struct Shard
+    {
+        CLock lock;
+        CArena arena;
+        EntryTable table;
+
+        Shard(): arena(SIZE_16K) {}
+    };
+
+    // 分配ID并记入ID表
+    uint32_t add_entry(CInternedString::Entry* entry);
+
+private:
+    mutable Shard _shards[SHARD_NUMBER];
+    CLock _id_lock;
+    const CInternedString::Entry** _chunks[CHUNK_NUMBER];
+    uint32_t _size;
+};
+
+SYS_NAMESPACE_END
+
+namespace std {
+template <>
+struct hash<mooon::sys::CInternedString>
+{
+    size_t operator ()(const mooon::sys::CInternedString& str) const
+    {
+        return static_cast<size_t>(str.hash());
+    }
+};
+} // namespace std
+
+#endif // MOOON_SYS_STRING_INTERNER_H
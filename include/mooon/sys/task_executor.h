@@ -0,0 +1,210 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_TASK_EXECUTOR_H
+#define MOOON_SYS_TASK_EXECUTOR_H
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/task_scheduler.h"
+#include "mooon/utils/bind.h"
+#include <deque>
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 任务的完成通知，由调用者创建并保证在任务完成前一直有效，
+  * 可以被多个线程等待，reset后可复用于下一个任务
+  */
+class CTaskFuture
+{
+    friend class CTaskExecutor;
+
+public:
+    CTaskFuture();
+
+    /** 任务是否已完成（包括抛出异常） */
+    bool is_done() const;
+
+    /** 等待任务完成 */
+    void wait();
+
+    /***
+      * 超时等待任务完成
+      * @return: 如果任务已完成返回true，超时返回false
+      */
+    bool timed_wait(uint32_t milliseconds);
+
+    /** 任务是否抛出了异常，须在任务完成后调用 */
+    bool is_failed() const { return _failed; }
+
+    /** 得到任务抛出的异常信息，须在任务完成后调用 */
+    const std::string& get_error() const { return _error; }
+
+    /** 复位，以便复用于下一个任务 */
+    void reset();
+
+private:
+    void set_done(const char* error);
+
+private:
+    mutable CLock _lock;
+    CEvent _event;
+    bool _done;
+    bool _failed;
+    std::string _error;
+};
+
+class CTaskWorker;
+
+/***
+  * 基于任务的执行器，和CThreadPool不同，调用者提交的是任务而不是分配线程，
+  * 每个工作线程有自己的任务队列，空闲的线程从其它线程的队列中窃取任务，
+  * 这样执行时长不均匀的任务也不会使部分线程空闲而另一些线程积压。
+  *
+  * 任务为utils::bind的结果，即utils::Functor<void>，
+  * 在工作线程中提交的任务放入该线程自己的队列（后进先出，利于缓存），
+  * 其它线程提交的按轮询放入各队列，窃取时从队列头部取（先进先出）。
+  * Functor内联存储绑定的函数对象，任务对象执行后回收到队列的空闲链表中复用，
+  * 所以稳定运行时提交任务不从堆上分配内存。
+  *
+  * 交互的请求和批量任务共用一个执行器时，create前以set_lanes设置多个通道，
+  * 之后所有任务都进入一个共享的CTaskScheduler，按通道的权重公平出队，通道内按截止时间，
+  * 不再按线程分队列和窃取（共享队列的锁竞争更多，但保证了全局的优先次序）。
+  * 带截止时间的任务执行前已过截止时间时不再执行，视为以“deadline exceeded”失败，
+  * future和callback照常被通知，未设置通道时也如此。
+  *
+  * 使用示例：
+  * CTaskExecutor executor;
+  * CTaskFuture future;
+  * executor.create(4);
+  * executor.submit(utils::bind<void>(&foo, 1), &future);
+  * future.wait();
+  * executor.destroy();
+  */
+class CTaskExecutor
+{
+    friend class CTaskWorker;
+
+public:
+    CTaskExecutor();
+    ~CTaskExecutor();
+
+    /***
+      * 创建并启动工作线程
+      * @worker_number: 工作线程个数，为0时取CPU个数
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void create(uint16_t worker_number=0);
+
+    /***
+      * 设置调度通道的权重，如{8, 1}表示通道0和1都有积压时按8:1出队，须在create之前调用，
+      * 未调用时不分通道，submit的CTaskPriority只有截止时间起作用
+      */
+    void set_lanes(const std::vector<uint32_t>& lane_weights) { _lane_weights = lane_weights; }
+
+    /***
+      * 停止接受新的任务（工作线程中执行的任务仍可提交），
+      * 等待所有已提交的任务执行完后，停止并销毁所有工作线程
+      */
+    void destroy();
+
+    /***
+      * 提交任务，任务对象的所有权转移给执行器
+      * @functor: 由utils::bind得到的任务
+      * @future: 任务完成时被通知，可为NULL
+      * @return: 如果执行器未创建或正在销毁，返回false，任务被丢弃
+      */
+    bool submit(utils::Functor<void> functor, CTaskFuture* future=NULL);
+
+    /***
+      * 提交任务，任务完成后在同一个工作线程中调用callback
+      * callback在任务抛出异常时也会被调用
+      */
+    bool submit(utils::Functor<void> functor, utils::Functor<void> callback);
+
+    /***
+      * 按调度属性提交任务，未带CTaskPriority的submit即通道0、没有截止时间
+      * 例：executor.submit(utils::bind<void>(&serve, request), CTaskPriority::with_timeout(0, 200), &future);
+      */
+    bool submit(utils::Functor<void> functor, const CTaskPriority& priority, CTaskFuture* future=NULL);
+    bool submit(utils::Functor<void> functor, const CTaskPriority& priority, utils::Functor<void> callback);
+
+    /** 得到工作线程个数 */
+    uint16_t get_worker_number() const { return static_cast<uint16_t>(_workers.size()); }
+
+    /** 得到还在队列中未被执行的任务数 */
+    uint32_t get_pending_number() const { return __atomic_load_n(&_pending_number, __ATOMIC_SEQ_CST); }
+
+    /** 得到已执行完的任务数 */
+    uint64_t get_executed_number() const { return __atomic_load_n(&_executed_number, __ATOMIC_RELAXED); }
+
+    /** 得到被窃取执行的任务数 */
+    uint64_t get_stolen_number() const { return __atomic_load_n(&_stolen_number, __ATOMIC_RELAXED); }
+
+    /** 得到因过了截止时间而未执行的任务数，不计入get_executed_number */
+    uint64_t get_expired_number() const { return __atomic_load_n(&_expired_number, __ATOMIC_RELAXED); }
+
+private:
+    struct Task
+    {
+        utils::Functor<void> function;
+        utils::Functor<void> callback;
+        CTaskFuture* future;
+        uint64_t deadline; // 0表示没有截止时间
+        Task* next; // 空闲链表
+    };
+
+    struct TaskQueue
+    {
+        CLock lock;
+        std::deque<Task*> tasks;
+        Task* free_tasks; // 执行完的任务对象，由提交到该队列的任务复用
+        char pad[CACHE_LINE_SIZE]; // 避免相邻队列的伪共享
+
+        TaskQueue(): free_tasks(NULL) {}
+        ~TaskQueue();
+    };
+
+private:
+    bool push_task(utils::Functor<void>* functor, utils::Functor<void>* callback, CTaskFuture* future, const CTaskPriority& priority);
+    void free_task(Task* task);
+    Task* take_task(uint16_t index);
+    Task* take_scheduled_task();
+    void execute(Task* task);
+    void finish(Task* task, const char* error);
+    void wakeup_idle(uint16_t index);
+
+private:
+    volatile bool _accepting;
+    uint32_t _next_queue;
+    uint32_t _pending_number;
+    uint64_t _executed_number;
+    uint64_t _stolen_number;
+    uint64_t _expired_number;
+    std::vector<TaskQueue*> _queues;
+    std::vector<CTaskWorker*> _workers;
+
+private: // 设置了通道时，所有任务都在_scheduler中
+    std::vector<uint32_t> _lane_weights;
+    CLock _scheduler_lock;
+    CTaskScheduler<Task*>* _scheduler;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_TASK_EXECUTOR_H
@@ -0,0 +1,219 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_TASK_SCHEDULER_H
+#define MOOON_SYS_TASK_SCHEDULER_H
+#include "mooon/sys/clock.h"
+#include <algorithm>
+#include <deque>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 任务的调度属性，用于CTaskExecutor::submit和net::CEventLoop::post
+  */
+struct CTaskPriority
+{
+    uint16_t lane;                  /** 所在的通道，见CTaskScheduler，超出通道数时归入最后一个通道 */
+    uint64_t deadline_milliseconds; /** 截止时间（CClock::get_milliseconds的单调毫秒数），0表示没有截止时间 */
+
+    CTaskPriority(uint16_t lane_=0, uint64_t deadline_milliseconds_=0)
+        : lane(lane_), deadline_milliseconds(deadline_milliseconds_)
+    {
+    }
+
+    /** timeout_milliseconds毫秒后截止 */
+    static CTaskPriority with_timeout(uint16_t lane, uint32_t timeout_milliseconds)
+    {
+        return CTaskPriority(lane, CClock::get_milliseconds() + timeout_milliseconds);
+    }
+};
+
+/***
+  * 多通道的任务调度队列，让交互的请求和批量的后台任务共用线程时互不拖累：
+  * 1) 各通道按权重公平出队（平滑的加权轮询），如权重为{8, 1}时，两个通道都有积压时按8:1出队，
+  *    只有一个通道有任务时它独占，所以批量任务不会饿死，也不会挤占交互请求
+  * 2) 同一通道内，有截止时间的任务按截止时间最早的先出（EDF），都先于没有截止时间的任务，
+  *    没有截止时间的任务先进先出
+  * 3) 出队时已过截止时间的任务不再出队，而是交给调用者丢弃，以免为已经没有意义的任务浪费时间，
+  *    并使后面的任务也跟着超时
+  *
+  * 非线程安全，由调用者加锁，T须可移动（如指针、utils::Functor）。
+  */
+template <typename T>
+class CTaskScheduler
+{
+public:
+    /***
+      * @lane_weights: 各通道的权重，为空时只有一个通道，为0的权重按1算
+      */
+    CTaskScheduler(const std::vector<uint32_t>& lane_weights=std::vector<uint32_t>())
+        : _size(0), _sequence(0)
+    {
+        set_lanes(lane_weights);
+    }
+
+    /** 重新设置通道，只能在队列为空时调用 */
+    void set_lanes(const std::vector<uint32_t>& lane_weights)
+    {
+        _lanes.clear();
+        _lanes.resize(lane_weights.empty()? 1: lane_weights.size());
+        for (typename std::vector<Lane>::size_type i=0; i<lane_weights.size(); ++i)
+            _lanes[i].weight = (0 == lane_weights[i])? 1: lane_weights[i];
+    }
+
+    /** 入队，task被移走 */
+    void push(T& task, const CTaskPriority& priority=CTaskPriority())
+    {
+        Lane& lane = _lanes[std::min<size_t>(priority.lane, _lanes.size()-1)];
+        if (0 == priority.deadline_milliseconds)
+        {
+            lane.fifo.push_back(static_cast<T&&>(task));
+        }
+        else
+        {
+            // 序号使截止时间相同的任务先进先出
+            lane.heap.push_back(Entry(priority.deadline_milliseconds, _sequence++, task));
+            std::push_heap(lane.heap.begin(), lane.heap.end(), EntryGreater());
+        }
+        ++_size;
+    }
+
+    /***
+      * 出队
+      * @now_milliseconds: 当前的单调毫秒数，截止时间早于它的任务被移到expired中
+      * @task: 出队的任务
+      * @expired: 已过截止时间的任务，为NULL时直接析构
+      * @return: 队列为空（或全是过期的任务）时返回false
+      */
+    bool pop(uint64_t now_milliseconds, T* task, std::vector<T>* expired)
+    {
+        drop_expired(now_milliseconds, expired);
+        if (0 == _size)
+            return false;
+
+        // 平滑的加权轮询：各非空通道的当前值加上权重，取最大的，再减去所有非空通道的权重之和
+        Lane* chosen = NULL;
+        int64_t total_weight = 0;
+        for (typename std::vector<Lane>::size_type i=0; i<_lanes.size(); ++i)
+        {
+            Lane& lane = _lanes[i];
+            if (lane.empty())
+            {
+                lane.current = 0; // 空的通道不累积份额
+                continue;
+            }
+
+            lane.current += lane.weight;
+            total_weight += lane.weight;
+            if ((NULL == chosen) || (lane.current > chosen->current))
+                chosen = &lane;
+        }
+
+        chosen->current -= total_weight;
+        if (!chosen->heap.empty())
+        {
+            std::pop_heap(chosen->heap.begin(), chosen->heap.end(), EntryGreater());
+            *task = static_cast<T&&>(chosen->heap.back().task);
+            chosen->heap.pop_back();
+        }
+        else
+        {
+            *task = static_cast<T&&>(chosen->fifo.front());
+            chosen->fifo.pop_front();
+        }
+
+        --_size;
+        return true;
+    }
+
+    /***
+      * 将已过截止时间的任务移到expired中，为NULL时直接析构
+      * @return: 过期的任务数
+      */
+    size_t drop_expired(uint64_t now_milliseconds, std::vector<T>* expired)
+    {
+        size_t number = 0;
+        for (typename std::vector<Lane>::size_type i=0; i<_lanes.size(); ++i)
+        {
+            std::vector<Entry>& heap = _lanes[i].heap;
+            while (!heap.empty() && (heap.front().deadline < now_milliseconds))
+            {
+                std::pop_heap(heap.begin(), heap.end(), EntryGreater());
+                if (expired != NULL)
+                    expired->push_back(static_cast<T&&>(heap.back().task));
+                heap.pop_back();
+                ++number;
+            }
+        }
+
+        _size -= number;
+        return number;
+    }
+
+    size_t size() const { return _size; }
+    bool empty() const { return 0 == _size; }
+    uint16_t get_lane_number() const { return static_cast<uint16_t>(_lanes.size()); }
+
+    /** 得到通道中的任务数，包括已过期但还未被丢弃的 */
+    size_t get_lane_size(uint16_t lane) const
+    {
+        return (lane < _lanes.size())? _lanes[lane].fifo.size() + _lanes[lane].heap.size(): 0;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t deadline;
+        uint64_t sequence;
+        T task;
+
+        Entry(uint64_t deadline_, uint64_t sequence_, T& task_)
+            : deadline(deadline_), sequence(sequence_), task(static_cast<T&&>(task_))
+        {
+        }
+    };
+
+    // 用于小顶堆，截止时间最早的在堆顶
+    struct EntryGreater
+    {
+        bool operator ()(const Entry& lhs, const Entry& rhs) const
+        {
+            return (lhs.deadline != rhs.deadline)? (lhs.deadline > rhs.deadline): (lhs.sequence > rhs.sequence);
+        }
+    };
+
+    struct Lane
+    {
+        uint32_t weight;
+        int64_t current;
+        std::deque<T> fifo;
+        std::vector<Entry> heap;
+
+        Lane(): weight(1), current(0) {}
+        bool empty() const { return fifo.empty() && heap.empty(); }
+    };
+
+private:
+    size_t _size;
+    uint64_t _sequence;
+    std::vector<Lane> _lanes;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_TASK_SCHEDULER_H
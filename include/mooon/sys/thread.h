@@ -23,6 +23,8 @@
 #include "mooon/sys/utils.h"
 #include "mooon/sys/ref_countable.h"
 #include <pthread.h>
+#include <string>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
 /**
@@ -79,6 +81,22 @@ public:
       */
     size_t get_stack_size() const;
 
+    /** 设置线程绑定的CPU。应当在start之前调用，否则设置无效，线程从创建起即运行在这些CPU上。
+      * @cpus: CPU编号列表，为空表示不绑定
+      * @exception: 不抛出异常，CPU编号无效时由start抛出异常
+      */
+    void set_cpu_affinity(const std::vector<int>& cpus) { _cpus = cpus; }
+
+    /** 得到由set_cpu_affinity设置的CPU列表 */
+    const std::vector<int>& get_cpu_affinity() const { return _cpus; }
+
+    /** 设置线程名。应当在start之前调用，线程启动时以pthread_setname_np设置（系统只保留前15个字节，
+      * 可在top -H和gdb中看到），并以完整的名字登记到CThreadSampler，按线程输出CPU和调度度量
+      * @name: 为空表示不设置，也不登记
+      */
+    void set_name(const std::string& name) { _name = name; }
+    const std::string& get_name() const { return _name; }
+
     /** 得到本线程号 */
     uint32_t get_thread_id() const { return _thread; }
     
@@ -131,7 +149,9 @@ private:
 private:
     pthread_t _thread;
     pthread_attr_t _attr;
-    size_t _stack_size;    
+    size_t _stack_size;
+    std::vector<int> _cpus;
+    std::string _name;
 };
 
 
@@ -21,10 +21,13 @@
 #ifndef MOOON_SYS_THREAD_ENGINE_H
 #define MOOON_SYS_THREAD_ENGINE_H
 #include "mooon/sys/syscall_exception.h"
+#include "mooon/utils/function_storage.h"
 #include <stdint.h> // pthread_t在32位上是4字节，在64位上是8字节
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
 // 基类
@@ -33,6 +36,9 @@ class Function
 public:
     virtual ~Function() {}
     virtual void operator ()() = 0;
+
+    // 由utils::CFunctionStorage实现，用于移动内联存储的函数对象
+    virtual Function* move_to(void* buffer) { return NULL; }
 };
 
 // 当前版本支持最多9个参数
@@ -563,173 +569,175 @@ private:
 };
 
 ////////////////////////////////////////////////////////////////////////////////
+// 同utils::Functor，函数对象不超过FUNCTOR_INLINE_SIZE时内联存储，复制即转移
 class Functor
 {
 public:
     Functor()
-        : _function(NULL)
     {
     }
     
     Functor(const Functor& other)
     {
-        _function = other._function;
-        
-        Functor& mutable_other = const_cast<Functor&>(other);
-        mutable_other._function = NULL;
+        _storage.move_from(&const_cast<Functor&>(other)._storage);
     }
 
-    ~Functor()
+    Functor(Functor&& other) noexcept
     {
-        delete _function;
+        _storage.move_from(&other._storage);
     }
 
     Functor& operator =(const Functor& other)
     {
-        _function = other._function;
-        
-        Functor& mutable_other = const_cast<Functor&>(other);
-        mutable_other._function = NULL;
+        _storage.move_from(&const_cast<Functor&>(other)._storage);
+        return *this;
+    }
 
+    Functor& operator =(Functor&& other) noexcept
+    {
+        _storage.move_from(&other._storage);
         return *this;
     }
     
     void operator ()()
     {
-        (*_function)();
+        (*_storage.get())();
     }
+
+    bool empty() const { return NULL == _storage.get(); }
+    bool is_inline() const { return _storage.is_inline(); }
     
     // 不带参数
     Functor(FunctionWithoutParameter::FunctionPtr function_ptr)
     {
-        _function = new FunctionWithoutParameter(function_ptr);
+        _storage.create<FunctionWithoutParameter >(function_ptr);
     }
 
     template <class ObjectType>
     Functor(typename MemberFunctionWithoutParameter<ObjectType>::MemberFunctionPtr member_function_ptr, ObjectType* object)
     {
-        _function = new MemberFunctionWithoutParameter<ObjectType>(member_function_ptr, object);
+        _storage.create<MemberFunctionWithoutParameter<ObjectType> >(member_function_ptr, object);
     }
    
     // 带1个参数
     template <typename ParameterType>
     Functor(typename FunctionWith1Parameter<ParameterType>::FunctionPtr function_ptr, ParameterType parameter)
     {
-        _function = new FunctionWith1Parameter<ParameterType>(function_ptr, parameter);
+        _storage.create<FunctionWith1Parameter<ParameterType> >(function_ptr, parameter);
     }
 
     template <class ObjectType, typename ParameterType>
     Functor(typename MemberFunctionWith1Parameter<ObjectType, ParameterType>::MemberFunctionPtr member_function_ptr, ObjectType* object, ParameterType parameter)
     {
-        _function = new MemberFunctionWith1Parameter<ObjectType, ParameterType>(member_function_ptr, object, parameter);
+        _storage.create<MemberFunctionWith1Parameter<ObjectType, ParameterType> >(member_function_ptr, object, parameter);
     }
 
     // 带2个参数
     template <typename Parameter1Type, typename Parameter2Type>
     Functor(typename FunctionWith2Parameter<Parameter1Type, Parameter2Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2)
     {
-        _function = new FunctionWith2Parameter<Parameter1Type, Parameter2Type>(function_ptr, parameter1, parameter2);
+        _storage.create<FunctionWith2Parameter<Parameter1Type, Parameter2Type> >(function_ptr, parameter1, parameter2);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type>
     Functor(typename MemberFunctionWith2Parameter<ObjectType, Parameter1Type, Parameter2Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2)
     {
-        _function = new MemberFunctionWith2Parameter<ObjectType, Parameter1Type, Parameter2Type>(member_function_ptr, object, parameter1, parameter2);
+        _storage.create<MemberFunctionWith2Parameter<ObjectType, Parameter1Type, Parameter2Type> >(member_function_ptr, object, parameter1, parameter2);
     }
 
     // 带3个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type>
     Functor(typename FunctionWith3Parameter<Parameter1Type, Parameter2Type, Parameter3Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3)
     {
-        _function = new FunctionWith3Parameter<Parameter1Type, Parameter2Type, Parameter3Type>(function_ptr, parameter1, parameter2, parameter3);
+        _storage.create<FunctionWith3Parameter<Parameter1Type, Parameter2Type, Parameter3Type> >(function_ptr, parameter1, parameter2, parameter3);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type>
     Functor(typename MemberFunctionWith3Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3)
     {
-        _function = new MemberFunctionWith3Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type>(member_function_ptr, object, parameter1, parameter2, parameter3);
+        _storage.create<MemberFunctionWith3Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type> >(member_function_ptr, object, parameter1, parameter2, parameter3);
     }
 
     // 带4个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type>
     Functor(typename FunctionWith4Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4)
     {
-        _function = new FunctionWith4Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>(function_ptr, parameter1, parameter2, parameter3, parameter4);
+        _storage.create<FunctionWith4Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type>
     Functor(typename MemberFunctionWith4Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4)
     {
-        _function = new MemberFunctionWith4Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4);
+        _storage.create<MemberFunctionWith4Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4);
     }
 
     // 带5个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type>
     Functor(typename FunctionWith5Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5)
     {
-        _function = new FunctionWith5Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5);
+        _storage.create<FunctionWith5Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type>
     Functor(typename MemberFunctionWith5Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5)
     {
-        _function = new MemberFunctionWith5Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5);
+        _storage.create<MemberFunctionWith5Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5);
     }
 
     // 带6个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type>
     Functor(typename FunctionWith6Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6)
     {
-        _function = new FunctionWith6Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type>(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6);
+        _storage.create<FunctionWith6Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type>
     Functor(typename MemberFunctionWith6Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6)
     {
-        _function = new MemberFunctionWith6Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6);
+        _storage.create<MemberFunctionWith6Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6);
     }
 
     // 带7个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type, typename Parameter7Type>
     Functor(typename FunctionWith7Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6, Parameter7Type parameter7)
     {
-        _function = new FunctionWith7Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type>(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7);
+        _storage.create<FunctionWith7Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type, typename Parameter7Type>
     Functor(typename MemberFunctionWith7Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6, Parameter7Type parameter7)
     {
-        _function = new MemberFunctionWith7Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7);
+        _storage.create<MemberFunctionWith7Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7);
     }
 
     // 带8个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type, typename Parameter7Type, typename Parameter8Type>
     Functor(typename FunctionWith8Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6, Parameter7Type parameter7, Parameter8Type parameter8)
     {
-        _function = new FunctionWith8Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type>(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8);
+        _storage.create<FunctionWith8Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type, typename Parameter7Type, typename Parameter8Type>
     Functor(typename MemberFunctionWith8Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6, Parameter7Type parameter7, Parameter8Type parameter8)
     {
-        _function = new MemberFunctionWith8Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8);
+        _storage.create<MemberFunctionWith8Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8);
     }
 
     // 带9个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type, typename Parameter7Type, typename Parameter8Type, typename Parameter9Type>
     Functor(typename FunctionWith9Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type, Parameter9Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6, Parameter7Type parameter7, Parameter8Type parameter8, Parameter9Type parameter9)
     {
-        _function = new FunctionWith9Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type, Parameter9Type>(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8, parameter9);
+        _storage.create<FunctionWith9Parameter<Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type, Parameter9Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8, parameter9);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type, typename Parameter6Type, typename Parameter7Type, typename Parameter8Type, typename Parameter9Type>
     Functor(typename MemberFunctionWith9Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type, Parameter9Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5, Parameter6Type parameter6, Parameter7Type parameter7, Parameter8Type parameter8, Parameter9Type parameter9)
     {
-        _function = new MemberFunctionWith9Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type, Parameter9Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8, parameter9);
+        _storage.create<MemberFunctionWith9Parameter<ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type, Parameter6Type, Parameter7Type, Parameter8Type, Parameter9Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5, parameter6, parameter7, parameter8, parameter9);
     }
 
-public:
-    Function* _function;
+private:
+    utils::CFunctionStorage<Function> _storage;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -908,16 +916,55 @@ public:
     CThreadEngine(const Functor& functor)
         : _thread(0)
     {
-        // bind()返回的是一个临时对象，
-        // 故需要new一个，以便在thread_proc()过程中有效
-        Functor* new_functor = new Functor(functor);
+        create(functor, NULL);
+    }
 
-        int errcode = pthread_create(&_thread, NULL, thread_proc, new_functor);
+    /***
+      * 以指定的栈大小和CPU亲和性创建线程，线程从创建起即运行在指定的CPU上
+      * @stack_size: 栈大小字节数，为0时使用系统默认值
+      * @cpus: 绑定的CPU编号列表，为空表示不绑定
+      */
+    CThreadEngine(const Functor& functor, size_t stack_size, const std::vector<int>& cpus=std::vector<int>())
+        : _thread(0)
+    {
+        pthread_attr_t attr;
+        int errcode = pthread_attr_init(&attr);
         if (errcode != 0)
+            THROW_SYSCALL_EXCEPTION(strerror(errcode), errcode, "pthread_attr_init");
+
+        try
         {
-            delete new_functor;
-            THROW_SYSCALL_EXCEPTION(strerror(errcode), errcode, "pthread_create");
+            if (stack_size > 0)
+            {
+                errcode = pthread_attr_setstacksize(&attr, stack_size);
+                if (errcode != 0)
+                    THROW_SYSCALL_EXCEPTION(strerror(errcode), errcode, "pthread_attr_setstacksize");
+            }
+            if (!cpus.empty())
+            {
+                cpu_set_t cpu_set;
+                CPU_ZERO(&cpu_set);
+                for (std::vector<int>::size_type i=0; i<cpus.size(); ++i)
+                {
+                    if ((cpus[i] < 0) || (cpus[i] >= CPU_SETSIZE))
+                        THROW_SYSCALL_EXCEPTION(strerror(EINVAL), EINVAL, "CPU_SET");
+                    CPU_SET(cpus[i], &cpu_set);
+                }
+
+                errcode = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+                if (errcode != 0)
+                    THROW_SYSCALL_EXCEPTION(strerror(errcode), errcode, "pthread_attr_setaffinity_np");
+            }
+
+            create(functor, &attr);
         }
+        catch (...)
+        {
+            pthread_attr_destroy(&attr);
+            throw;
+        }
+
+        pthread_attr_destroy(&attr);
     }
     
     ~CThreadEngine()
@@ -961,6 +1008,22 @@ public:
         }
     }
 
+private:
+    void create(const Functor& functor, const pthread_attr_t* attr)
+    {
+        // bind()返回的是一个临时对象，
+        // 故需要new一个，以便在thread_proc()过程中有效，
+        // 绑定的函数对象通常内联在Functor中，只有这一次分配
+        Functor* new_functor = new Functor(functor);
+
+        int errcode = pthread_create(&_thread, attr, thread_proc, new_functor);
+        if (errcode != 0)
+        {
+            delete new_functor;
+            THROW_SYSCALL_EXCEPTION(strerror(errcode), errcode, "pthread_create");
+        }
+    }
+
 private:
     CThreadEngine();
     CThreadEngine(const CThreadEngine&);
@@ -0,0 +1,82 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_THREAD_PLACEMENT_H
+#define MOOON_SYS_THREAD_PLACEMENT_H
+#include "mooon/sys/config.h"
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/** 线程放置策略 */
+typedef enum
+{
+    placement_none,     /** 不绑定，由系统调度 */
+    placement_compact,  /** 依次绑定到各CPU，先占满一个NUMA节点再到下一个，适合线程间共享数据多的场景 */
+    placement_scatter,  /** 依次轮流绑定到各NUMA节点的CPU上，适合需要整机内存带宽的场景 */
+    placement_explicit, /** 依次绑定到指定的CPU列表，线程数多于列表长度时循环使用 */
+    placement_numa_node /** 每个线程绑定到一个NUMA节点（可在节点内的CPU间迁移），线程依次轮流分配到各节点 */
+}placement_policy_t;
+
+/***
+  * 根据放置策略和机器拓扑（/sys/devices/system/node），计算线程池中各线程应绑定的CPU和NUMA节点，
+  * 拓扑在构造时读取，非NUMA系统视为只有一个节点
+  *
+  * 使用示例：
+  * CThreadPool<CMyThread> thread_pool;
+  * thread_pool.create(8, NULL, CThreadPlacement(placement_scatter));
+  */
+class CThreadPlacement
+{
+public:
+    /***
+      * @policy: 放置策略
+      * @cpus: placement_explicit时使用的CPU编号列表，其它策略忽略
+      */
+    CThreadPlacement(placement_policy_t policy=placement_none, const std::vector<int>& cpus=std::vector<int>());
+
+    placement_policy_t get_policy() const { return _policy; }
+
+    /***
+      * 得到第index个线程应绑定的CPU列表
+      * @return: 如果不需要绑定（placement_none或拓扑不可用）则返回空列表
+      */
+    std::vector<int> get_cpus(uint16_t index) const;
+
+    /***
+      * 得到第index个线程所在的NUMA节点，供线程分配本节点的内存（如CRawMemPool）
+      * @return: 如果不确定（如placement_none或绑定的CPU不在任何节点上），返回-1
+      */
+    int get_numa_node(uint16_t index) const;
+
+    /** 得到NUMA节点个数 */
+    uint16_t get_numa_node_number() const { return static_cast<uint16_t>(_node_cpus.size()); }
+
+private:
+    // 得到CPU所在的节点，不存在返回-1
+    int get_cpu_node(int cpu) const;
+
+private:
+    placement_policy_t _policy;
+    std::vector<int> _explicit_cpus;
+    std::vector<int> _compact_cpus;              /** 按节点顺序排列的所有CPU */
+    std::vector<std::vector<int> > _node_cpus;   /** 有CPU的各节点的CPU列表 */
+    std::vector<int> _node_ids;                  /** _node_cpus对应的节点编号 */
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_THREAD_PLACEMENT_H
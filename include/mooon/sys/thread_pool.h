@@ -18,9 +18,33 @@
  */
 #ifndef MOOON_SYS_THREAD_POOL_H
 #define MOOON_SYS_THREAD_POOL_H
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/thread_placement.h"
 #include "mooon/sys/utils.h"
+#include "mooon/utils/string_utils.h"
 SYS_NAMESPACE_BEGIN
 
+/***
+  * 弹性线程池的伸缩策略，见CThreadPool::create_elastic
+  */
+struct CElasticPolicy
+{
+    uint16_t min_thread_count;      /** 最少的线程数，create_elastic时创建 */
+    uint16_t max_thread_count;      /** 最多的线程数 */
+    uint16_t grow_step;             /** 每次扩容增加的线程数 */
+    uint64_t wait_p99_threshold_ns; /** 队列等待时长的p99超过时扩容 */
+    uint32_t backlog_per_thread;    /** 积压超过“线程数*backlog_per_thread”时扩容，0表示不按积压扩容 */
+    uint32_t cooldown_seconds;      /** 持续空闲（无积压且p99不超过阈值）这么久后退掉一个线程，之后每过一个周期再退一个 */
+    std::string name;               /** 度量名：thread_pool.<name>.threads、scale_up、scale_down和wait_ns，
+                                        未调用CThreadPool::set_name时也作为线程名的前缀 */
+
+    CElasticPolicy()
+        : min_thread_count(1), max_thread_count(16), grow_step(1),
+          wait_p99_threshold_ns(10*1000*1000), backlog_per_thread(0), cooldown_seconds(60)
+    {
+    }
+};
+
 /***
   * 线程池模板类，模板参数为线程类
   */
@@ -33,25 +57,46 @@ public:
         :_next_thread(0)
         ,_thread_count(0)
         ,_thread_array(NULL)
+        ,_max_thread_count(0)
+        ,_parameter(NULL)
+        ,_idle_since_milliseconds(0)
+        ,_wait_histogram(NULL)
+        ,_threads_gauge(NULL)
+        ,_scale_up_counter(NULL)
+        ,_scale_down_counter(NULL)
     {
     }
 
+    /***
+      * 设置池名，须在create之前调用，池线程被命名为“<池名>.<序号>”，
+      * 可按线程从CThreadSampler得到thread.<池名>.<序号>.cpu_permille等度量，
+      * 池名为空（默认）时不命名，弹性线程池则以CElasticPolicy.name为池名
+      */
+    void set_name(const std::string& name) { _name = name; }
+    const std::string& get_name() const { return _name; }
+
     /** 创建线程池，并启动线程池中的所有线程，
       * 池线程创建成功后，并不会立即进行运行状态，而是处于等待状态，
       * 所以需要唤醒它们，用法请参见后面的示例
       * @thread_count: 线程池中的线程个数
       * @parameter: 传递给池线程的参数
+      * @placement: 线程的CPU和NUMA节点放置策略，默认不绑定，
+      *             池线程可在set_parameter或before_start中通过get_numa_node分配本节点的内存
       * @exception: 可抛出CSyscallException异常，
       *             如果是因为CPoolThread::before_start返回false，则出错码为0
       */
-    void create(uint16_t thread_count, void* parameter=NULL)
+    void create(uint16_t thread_count, void* parameter=NULL, const CThreadPlacement& placement=CThreadPlacement())
     {
         _thread_array = new ThreadClass*[thread_count];
+        _max_thread_count = thread_count;
         for (uint16_t i=0; i<thread_count; ++i)
         {
             _thread_array[i] = new ThreadClass;            
             _thread_array[i]->inc_refcount();
             _thread_array[i]->set_index(i);
+            _thread_array[i]->set_cpu_affinity(placement.get_cpus(i));
+            _thread_array[i]->set_numa_node(placement.get_numa_node(i));
+            set_thread_name(_thread_array[i], i);
             _thread_array[i]->set_parameter(parameter);
         }
         for (uint16_t i=0; i<thread_count; ++i)
@@ -69,6 +114,114 @@ public:
         }
     }
 
+    /***
+      * 创建弹性线程池，先创建policy.min_thread_count个线程，之后由adjust按负载在最少和最多之间伸缩，
+      * 用于负载随时间大幅变化（如昼夜相差十倍）的场合，低谷时不占用多余的线程栈，高峰时不积压。
+      *
+      * 池线程通常从一个共享的队列（如CEventQueue）中取任务，取到后以record_wait记录任务在队列中等待的纳秒数，
+      * 调用者（通常是分派任务的线程）定时调用adjust，传入队列的积压数：
+      * 1) 等待时长的p99超过阈值，或积压过多时，增加grow_step个线程（新线程已被唤醒），不超过最多的线程数
+      * 2) 持续空闲cooldown_seconds秒后，退掉编号最大的线程，不少于最少的线程数，
+      *    退出时调用线程的stop并等待其退出，所以池线程的run应能定期返回（如以超时等待队列）
+      *
+      * 伸缩会改变get_thread_count和get_thread_array的结果，adjust和它们须在同一个线程中调用。
+      * @exception: 同create，扩容时出错也从adjust中抛出
+      */
+    void create_elastic(const CElasticPolicy& policy, void* parameter=NULL, const CThreadPlacement& placement=CThreadPlacement())
+    {
+        MOOON_ASSERT((policy.min_thread_count <= policy.max_thread_count) && (policy.max_thread_count > 0));
+        _policy = policy;
+        if (_name.empty())
+            _name = policy.name;
+        _parameter = parameter;
+        _placement = placement;
+        _max_thread_count = policy.max_thread_count;
+        _idle_since_milliseconds = 0;
+        _thread_array = new ThreadClass*[_max_thread_count];
+
+        const std::string prefix = "thread_pool." + policy.name + ".";
+        _wait_histogram = CMetricsRegistry::get_singleton()->get_histogram(prefix + "wait_ns");
+        _threads_gauge = CMetricsRegistry::get_singleton()->get_gauge(prefix + "threads");
+        _scale_up_counter = CMetricsRegistry::get_singleton()->get_counter(prefix + "scale_up");
+        _scale_down_counter = CMetricsRegistry::get_singleton()->get_counter(prefix + "scale_down");
+        try
+        {
+            grow(policy.min_thread_count, false);
+        }
+        catch (...)
+        {
+            destroy();
+            throw;
+        }
+    }
+
+    /** 是否为弹性线程池 */
+    bool is_elastic() const throw () { return _wait_histogram != NULL; }
+
+    /** 池线程记录一个任务在队列中等待的纳秒数，可在任意线程中调用，非弹性线程池时不起作用 */
+    void record_wait(uint64_t wait_nanoseconds)
+    {
+        if (_wait_histogram != NULL)
+            _wait_histogram->record(wait_nanoseconds);
+    }
+
+    /***
+      * 按上次adjust以来的等待时长和当前的积压数伸缩，非弹性线程池时不起作用
+      * @backlog: 队列中等待的任务数，如CEventQueue::size()
+      * @now_milliseconds: 当前的单调时间（毫秒），为0时取CClock::get_milliseconds()
+      * @return: 线程数的变化，正数为增加的，负数为退掉的，0为不变
+      */
+    int adjust(uint32_t backlog, uint64_t now_milliseconds=0)
+    {
+        if (NULL == _wait_histogram)
+            return 0;
+        if (0 == now_milliseconds)
+            now_milliseconds = CClock::get_milliseconds();
+
+        CHistogramSnapshot snapshot;
+        _wait_histogram->get_snapshot(&snapshot, true);
+        const uint64_t wait_p99 = snapshot.get_percentile(99);
+        const bool overloaded = (wait_p99 > _policy.wait_p99_threshold_ns)
+            || ((_policy.backlog_per_thread > 0) && (backlog > static_cast<uint64_t>(_policy.backlog_per_thread) * _thread_count));
+
+        if (overloaded)
+        {
+            _idle_since_milliseconds = 0;
+            if (_thread_count >= _max_thread_count)
+                return 0;
+
+            const uint16_t grow_step = (_policy.grow_step > 0)? _policy.grow_step: 1;
+            const uint16_t number = std::min<uint16_t>(grow_step, _max_thread_count - _thread_count);
+            grow(number, true);
+            _scale_up_counter->inc(number);
+            return number;
+        }
+
+        // 有积压但未超过阈值时既不扩容也不缩容
+        if (backlog > 0)
+        {
+            _idle_since_milliseconds = 0;
+            return 0;
+        }
+        if (0 == _idle_since_milliseconds)
+        {
+            _idle_since_milliseconds = now_milliseconds;
+            return 0;
+        }
+        if ((now_milliseconds - _idle_since_milliseconds < static_cast<uint64_t>(_policy.cooldown_seconds) * 1000)
+         || (_thread_count <= _policy.min_thread_count))
+            return 0;
+
+        // 退一个后重新计时，避免一次退掉太多，负载回升时来不及
+        _idle_since_milliseconds = now_milliseconds;
+        shrink();
+        _scale_down_counter->inc();
+        return -1;
+    }
+
+    /** 得到最多的线程数，非弹性线程池时为create时的线程数 */
+    uint16_t get_max_thread_count() const throw () { return _max_thread_count; }
+
     /** 销毁线程池，这里会等待所有线程退出，然后删除线程 */
     void destroy()
     {
@@ -84,6 +237,8 @@ public:
 
             delete []_thread_array;
             _thread_array = NULL;
+            if (_threads_gauge != NULL)
+                _threads_gauge->set(0);
         }
     }
 
@@ -133,10 +288,70 @@ public:
         return _thread_array[_next_thread++];
     }
 
+private:
+    void set_thread_name(ThreadClass* thread, uint16_t index)
+    {
+        if (!_name.empty())
+            thread->set_name(_name + "." + utils::CStringUtils::int_tostring(index));
+    }
+
+    // 在_thread_count之后增加number个线程，线程启动成功才计入
+    void grow(uint16_t number, bool wakeup)
+    {
+        for (uint16_t k=0; k<number; ++k)
+        {
+            const uint16_t i = _thread_count;
+            ThreadClass* thread = new ThreadClass;
+            thread->inc_refcount();
+            thread->set_index(i);
+            thread->set_cpu_affinity(_placement.get_cpus(i));
+            thread->set_numa_node(_placement.get_numa_node(i));
+            set_thread_name(thread, i);
+            thread->set_parameter(_parameter);
+            try
+            {
+                thread->start();
+            }
+            catch (...)
+            {
+                thread->dec_refcount();
+                throw;
+            }
+
+            _thread_array[i] = thread;
+            ++_thread_count;
+            if (wakeup)
+                thread->wakeup();
+        }
+        _threads_gauge->set(_thread_count);
+    }
+
+    // 退掉编号最大的线程，其它线程的编号不变
+    void shrink()
+    {
+        ThreadClass* thread = _thread_array[--_thread_count];
+        _thread_array[_thread_count] = NULL;
+        thread->stop();
+        thread->dec_refcount();
+        _threads_gauge->set(_thread_count);
+    }
+
 private:    
     uint16_t _next_thread;
     uint16_t _thread_count;    
     ThreadClass** _thread_array;
+    std::string _name;
+
+private: // 弹性线程池
+    uint16_t _max_thread_count;
+    void* _parameter;
+    CThreadPlacement _placement;
+    CElasticPolicy _policy;
+    uint64_t _idle_since_milliseconds; // 开始空闲的时间，0表示不空闲
+    CLatencyHistogram* _wait_histogram;
+    CGauge* _threads_gauge;
+    CCounter* _scale_up_counter;
+    CCounter* _scale_down_counter;
 };
 
 SYS_NAMESPACE_END
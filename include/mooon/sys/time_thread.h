@@ -11,6 +11,9 @@ SYS_NAMESPACE_BEGIN
 // 提供秒级时间，
 // 可用于避免多个线程重复调用time(NULL)
 // 注：32位平台上的毫秒级不准
+//
+// 另外提供取自单调时钟CClock的毫秒值，不受NTP和修改系统时间的影响，适用于超时判断，
+// 各次更新按单调时钟对齐到start时指定的间隔，不会因为更新本身的耗时而累积偏差
 class CTimeThread
 {
     SINGLETON_DECLARE(CTimeThread);
@@ -20,6 +23,7 @@ public:
     ~CTimeThread();
     int64_t get_seconds() const;
     int64_t get_milliseconds() const;
+    int64_t get_monotonic_milliseconds() const;
     void stop(); // 同一对象在stop后不能重复使用
     bool start(uint32_t interval_milliseconds);
     void wait();
@@ -30,9 +34,11 @@ private:
 #if __WORDSIZE==64
     CAtomic<int64_t> _seconds;
     CAtomic<int64_t> _milliseconds;
+    CAtomic<int64_t> _monotonic_milliseconds;
 #else
     CAtomic<int> _seconds;
     CAtomic<int> _milliseconds;
+    CAtomic<int> _monotonic_milliseconds;
 #endif // __WORDSIZE==64
     uint32_t _interval_milliseconds;
     CThreadEngine* _engine;
@@ -111,7 +111,28 @@ public:
     /** 得到CPU核个数
       * @return: 如果成功，返回大于0的CPU核个数，否则返回0
       */
-	static uint16_t get_cpu_number();    
+	static uint16_t get_cpu_number();
+
+    /** 得到NUMA节点个数，非NUMA系统或无法识别时返回1 */
+    static uint16_t get_numa_node_number();
+
+    /***
+      * 得到NUMA节点上的CPU编号列表
+      * @node: 节点编号，从0开始，非NUMA系统只有节点0，它包含所有CPU
+      * @cpus: 存储CPU编号，按从小到大顺序
+      * @return: 成功返回true，节点不存在返回false
+      */
+    static bool get_numa_node_cpus(int node, std::vector<int>* cpus);
+
+    /***
+      * 将内存绑定到指定的NUMA节点，之后首次访问的页从该节点分配，已分配的页被迁移过去，
+      * 使用优先（MPOL_PREFERRED）而非强制策略，节点内存不足时仍可从其它节点分配
+      * @addr: 内存起始地址，不要求页对齐，会扩展到所在的整页
+      * @size: 内存字节数
+      * @node: NUMA节点编号
+      * @return: 成功返回true，内核不支持或无权限时返回false，不影响内存的使用
+      */
+    static bool bind_numa_node(void* addr, size_t size, int node);
 
     /** 得到当前调用栈
       * 注意事项: 编译源代码时带上-rdynamic和-g选项，否则可能看到的是函数地址，而不是函数符号名称
@@ -120,11 +141,12 @@ public:
       */
     static bool get_backtrace(std::string& call_stack);
 
-    /** 得到指定目录字节数大小，非线程安全函数，同一时刻只能被一个线程调用
+    /** 得到指定目录下所有普通文件的字节数之和，不跟随符号链接
       * @dirpath: 目录路径
-      * @return: 目录字节数大小
+      * @num_threads: 以CDirWalker并行遍历的线程数
+      * @return: 目录字节数大小，出错返回-1
       */
-    static off_t du(const char* dirpath);
+    static off_t du(const char* dirpath, int num_threads=1);
 
     /** 得到内存页大小 */
     static int get_page_size();
@@ -20,6 +20,7 @@
 #ifndef MOOON_UTILS_AES_HELPER_H
 #define MOOON_UTILS_AES_HELPER_H
 #include "mooon/utils/exception.h"
+#include <sys/uio.h>
 UTILS_NAMESPACE_BEGIN
 
 // 高级加密标准（Advanced Encryption Standard），
@@ -63,5 +64,67 @@ private:
     std::string _key;
 };
 
+// 基于EVP的AES-GCM和AES-CTR流式加解密，CPU支持时OpenSSL自动使用AES-NI（GCM还使用PCLMUL），
+// 密钥只在构造时展开一次，每次begin_encrypt或begin_decrypt只重置IV，复用同一个EVP_CIPHER_CTX，
+// 非线程安全，每个线程使用各自的对象。
+// 出错抛出异常mooon::utils::CException
+//
+// 使用示例（加密分散在多个缓冲区中的数据）：
+// CAESCipher cipher(key); // key为16、24或32字节
+// cipher.begin_encrypt(iv, CAESCipher::gcm_iv_size);
+// size_t n = cipher.update(iov, iovcnt, out); // GCM和CTR输出与输入等长
+// cipher.finish_encrypt(tag);
+class CAESCipher
+{
+public:
+    enum cipher_mode_t
+    {
+        mode_gcm, // 带认证，IV通常为12字节，解密时校验16字节的tag
+        mode_ctr  // 不带认证，IV为16字节
+    };
+
+    enum
+    {
+        gcm_iv_size = 12,
+        ctr_iv_size = 16,
+        gcm_tag_size = 16
+    };
+
+public:
+    // key的长度必须为16、24或32字节（不同于CAESHelper，不自动填充）
+    CAESCipher(const std::string& key, cipher_mode_t mode=mode_gcm);
+    ~CAESCipher();
+
+    // 开始加密或解密一条消息，aad为GCM的附加认证数据（CTR忽略）
+    void begin_encrypt(const void* iv, size_t iv_size, const void* aad=NULL, size_t aad_size=0);
+    void begin_decrypt(const void* iv, size_t iv_size, const void* aad=NULL, size_t aad_size=0);
+
+    // 加解密一段数据，可多次调用，out可以和in相同（原地加解密）
+    // 返回写入out的字节数，总是等于输入的字节数
+    size_t update(const void* in, size_t size, void* out);
+    size_t update(const struct iovec* iov, int iovcnt, void* out);
+
+    // 结束加密，GCM时将tag写入tag（CTR时忽略tag）
+    void finish_encrypt(void* tag=NULL, size_t tag_size=gcm_tag_size);
+
+    // 结束解密，GCM时校验tag，不匹配返回false，此时已解密的数据不可信
+    bool finish_decrypt(const void* tag=NULL, size_t tag_size=gcm_tag_size);
+
+    // 一次加解密整条消息，GCM时out（或in）为密文之后紧跟16字节的tag
+    void encrypt(const void* iv, size_t iv_size, const std::string& in, std::string* out);
+    bool decrypt(const void* iv, size_t iv_size, const std::string& in, std::string* out);
+
+    cipher_mode_t mode() const { return _mode; }
+
+private:
+    CAESCipher(const CAESCipher&);
+    CAESCipher& operator =(const CAESCipher&);
+    void begin(bool encrypt, const void* iv, size_t iv_size, const void* aad, size_t aad_size);
+
+private:
+    void* _ctx; // EVP_CIPHER_CTX
+    cipher_mode_t _mode;
+};
+
 UTILS_NAMESPACE_END
 #endif // MOOON_UTILS_AES_HELPER_H
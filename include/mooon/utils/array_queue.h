@@ -86,6 +86,24 @@ public:
         return elem;
     }
     
+    /** 返回队尾元素 */
+    DataType back() const
+    {
+        return _elem_array[(_tail+_queue_max-1) % _queue_max];
+    }
+
+    /***
+      * 弹出队尾元素
+      * 注意: 调用之前应当先使用is_empty判断一下
+      * @return: 返回队尾元素
+      */
+    DataType pop_back()
+    {
+        _tail = (_tail+_queue_max-1) % _queue_max;
+        _queue_size = _queue_size - 1;
+        return _elem_array[_tail];
+    }
+
     /***
       * 往队尾插入一个元素
       * 注意: 调用pop之前应当先使用is_full判断一下
@@ -0,0 +1,148 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_BITMAP_H
+#define MOOON_UTILS_BITMAP_H
+#include "mooon/utils/string_simd.h"
+#include <vector>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 以64位字为单位的定长位图，位从0开始编号，第i位在第i/64个字的第i%64位，
+  * 查找、计数和范围操作一次处理一个字，
+  * 位图之间的与、或、异或和与非按CPU支持的指令集（AVX2、POPCNT）选择实现，一次处理256位，
+  * 适合上亿位的用户集合求交、求并。
+  *
+  * 不做越界检查，位置须小于size()；两个位图的运算要求大小相同，不同时只处理较小的部分。
+  * 非线程安全。
+  */
+class CBitmap
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+public:
+    CBitmap(size_t bit_number=0);
+
+    /** 改变位数，新增的位为0 */
+    void resize(size_t bit_number);
+
+    size_t size() const { return _bit_number; }
+    size_t word_number() const { return _words.size(); }
+    uint64_t* words() { return _words.empty()? NULL: &_words[0]; }
+    const uint64_t* words() const { return _words.empty()? NULL: &_words[0]; }
+
+    bool test(size_t position) const
+    {
+        return (_words[position >> 6] >> (position & 63)) & 1;
+    }
+
+    void set(size_t position)
+    {
+        _words[position >> 6] |= UINT64_C(1) << (position & 63);
+    }
+
+    void reset(size_t position)
+    {
+        _words[position >> 6] &= ~(UINT64_C(1) << (position & 63));
+    }
+
+    void flip(size_t position)
+    {
+        _words[position >> 6] ^= UINT64_C(1) << (position & 63);
+    }
+
+    /** 将[begin, end)的位置为1 */
+    void set(size_t begin, size_t end);
+
+    /** 将[begin, end)的位置为0 */
+    void reset(size_t begin, size_t end);
+
+    /** 所有位置为1 */
+    void set_all();
+
+    /** 所有位置为0 */
+    void reset_all();
+
+    /** 为1的位数 */
+    size_t count() const;
+
+    /** [begin, end)中为1的位数 */
+    size_t count(size_t begin, size_t end) const;
+
+    bool any() const;
+    bool none() const { return !any(); }
+
+    /***
+      * 查找from及之后第一个为1的位
+      * @return: 没有时返回npos
+      */
+    size_t find_first_set(size_t from=0) const;
+
+    /***
+      * 查找from及之后第一个为0的位
+      * @return: 没有时返回npos
+      */
+    size_t find_first_zero(size_t from=0) const;
+
+    /** 以下为和另一个位图的运算，结果存放在本位图 */
+    CBitmap& operator &=(const CBitmap& other);
+    CBitmap& operator |=(const CBitmap& other);
+    CBitmap& operator ^=(const CBitmap& other);
+    /** 本位图 & ~other，即去掉other中有的 */
+    CBitmap& and_not(const CBitmap& other);
+
+    /** 两个位图交集的位数，不生成交集 */
+    size_t and_count(const CBitmap& other) const;
+
+    bool operator ==(const CBitmap& other) const;
+    bool operator !=(const CBitmap& other) const { return !(*this == other); }
+
+public:
+    /***
+      * 以下为字数组的运算，dst和src可以不对齐，n为字数，
+      * CRoaringBitmap等以字数组存放位图的也可直接使用
+      */
+    static void and_words(uint64_t* dst, const uint64_t* src, size_t n);
+    static void or_words(uint64_t* dst, const uint64_t* src, size_t n);
+    static void xor_words(uint64_t* dst, const uint64_t* src, size_t n);
+    static void and_not_words(uint64_t* dst, const uint64_t* src, size_t n);
+    static size_t count_words(const uint64_t* words, size_t n);
+    static size_t and_count_words(const uint64_t* a, const uint64_t* b, size_t n);
+
+    /** 得到当前使用的指令集，sse4.2表示只使用POPCNT指令 */
+    static CStringSimd::isa_t get_isa();
+
+    /***
+      * 强制使用指定的指令集，超出CPU支持时使用CPU支持的最高指令集，
+      * 非线程安全，仅用于测试和性能对比
+      * @return: 实际使用的指令集
+      */
+    static CStringSimd::isa_t set_isa(CStringSimd::isa_t isa);
+
+private:
+    // 清除最后一个字中超出位数的位，保证计数和比较不受其影响
+    void trim();
+
+private:
+    size_t _bit_number;
+    std::vector<uint64_t> _words;
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_BITMAP_H
@@ -0,0 +1,143 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_BLOOM_FILTER_H
+#define MOOON_UTILS_BLOOM_FILTER_H
+#include "mooon/utils/sketch.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 分块的布隆过滤器，用于消息去重等，判断不存在时一定不存在，判断存在时有fpp的概率误判：
+  * 位数组分成多个512位（一个缓存行）的块，一个键的所有位都在同一块中，
+  * 一次查询最多访问一个缓存行，比标准的布隆过滤器快得多，代价是同样的误判率多占约10%~20%的位。
+  * 键的哈希为CHashUtils::xxhash64，已有哈希值的可直接使用*_hash版本。
+  * 不能删除，需要删除的使用CCuckooFilter。
+  * 非线程安全。
+  *
+  * 使用示例（消息去重）：
+  * CBloomFilter filter(10000000, 0.001);
+  * if (!filter.test_and_add(message_id)) process(message);
+  */
+class CBloomFilter: public CSketchStorage
+{
+public:
+    /** 默认构造的须attach或load后才能使用 */
+    CBloomFilter();
+
+    /***
+      * @expected_number: 预期的键数，超出后误判率上升
+      * @fpp: 预期的误判率
+      */
+    CBloomFilter(uint64_t expected_number, double fpp);
+
+    void add(const void* key, size_t size) { add_hash(CHashUtils::xxhash64(key, size)); }
+    void add(const std::string& key) { add_hash(CHashUtils::xxhash64(key)); }
+    void add_hash(uint64_t hash);
+
+    bool contains(const void* key, size_t size) const { return contains_hash(CHashUtils::xxhash64(key, size)); }
+    bool contains(const std::string& key) const { return contains_hash(CHashUtils::xxhash64(key)); }
+    bool contains_hash(uint64_t hash) const;
+
+    /***
+      * 判断是否（可能）存在并加入，用于去重
+      * @return: 加入前是否（可能）已存在
+      */
+    bool test_and_add(const void* key, size_t size) { return test_and_add_hash(CHashUtils::xxhash64(key, size)); }
+    bool test_and_add(const std::string& key) { return test_and_add_hash(CHashUtils::xxhash64(key)); }
+    bool test_and_add_hash(uint64_t hash);
+
+    /** 合并另一个（取并集），参数须相同，形状不同时返回false */
+    bool merge(const CBloomFilter& other);
+
+    /** 按已置位的比例估计当前的误判率 */
+    double estimate_fpp() const;
+
+    uint64_t get_bit_number() const { return static_cast<uint64_t>(_block_number) * BLOCK_BITS; }
+    uint32_t get_hash_number() const { return _hash_number; }
+
+private:
+    enum { BLOCK_BITS = 512, BLOCK_WORDS = BLOCK_BITS / 64 };
+
+    virtual bool restore(const uint64_t* params, size_t data_size);
+    uint64_t* get_block(uint64_t hash) const;
+
+private:
+    uint32_t _block_number;
+    uint32_t _hash_number;
+};
+
+/***
+  * 布谷鸟过滤器，和布隆过滤器一样判断键是否（可能）存在，但支持删除：
+  * 每个键存放16位的指纹，每个桶4个指纹，键可放在两个候选桶之一，
+  * 冲突时踢出已有的指纹到它的另一个桶，误判率约为8/65536（0.012%），
+  * 负载可达95%，满时add返回false。
+  * 只能删除确实加入过的键，否则可能删掉别的键的指纹（从而造成漏判）。
+  * 非线程安全。
+  */
+class CCuckooFilter: public CSketchStorage
+{
+public:
+    /** 默认构造的须attach或load后才能使用 */
+    CCuckooFilter();
+
+    /** @capacity: 最多的键数，桶数按95%的负载取整为2的幂 */
+    explicit CCuckooFilter(uint64_t capacity);
+
+    /***
+      * 加入一个键，同一个键可以加入多次（最多8次），删除时须删除同样的次数
+      * @return: 过滤器已满时返回false
+      */
+    bool add(const void* key, size_t size) { return add_hash(CHashUtils::xxhash64(key, size)); }
+    bool add(const std::string& key) { return add_hash(CHashUtils::xxhash64(key)); }
+    bool add_hash(uint64_t hash);
+
+    bool contains(const void* key, size_t size) const { return contains_hash(CHashUtils::xxhash64(key, size)); }
+    bool contains(const std::string& key) const { return contains_hash(CHashUtils::xxhash64(key)); }
+    bool contains_hash(uint64_t hash) const;
+
+    /** 删除一个键，不存在时返回false */
+    bool remove(const void* key, size_t size) { return remove_hash(CHashUtils::xxhash64(key, size)); }
+    bool remove(const std::string& key) { return remove_hash(CHashUtils::xxhash64(key)); }
+    bool remove_hash(uint64_t hash);
+
+    /** 存放的键数 */
+    uint64_t size() const;
+
+    uint64_t get_bucket_number() const { return _bucket_mask + 1; }
+
+private:
+    enum { BUCKET_SLOTS = 4, MAX_KICKS = 500 };
+
+    virtual bool restore(const uint64_t* params, size_t data_size);
+
+    // 数据的开头为两个64位：键数和被踢出后无处存放的指纹（0表示没有）及其桶
+    uint64_t* get_meta() const { return reinterpret_cast<uint64_t*>(_data); }
+    uint16_t* get_bucket(uint64_t index) const { return reinterpret_cast<uint16_t*>(_data + 16) + index * BUCKET_SLOTS; }
+    void place(uint64_t index, uint16_t fingerprint, uint64_t random);
+    uint64_t get_alternate(uint64_t index, uint16_t fingerprint) const;
+    bool insert_into(uint64_t index, uint16_t fingerprint);
+    bool remove_from(uint64_t index, uint16_t fingerprint);
+    bool bucket_contains(uint64_t index, uint16_t fingerprint) const;
+    static uint16_t get_fingerprint(uint64_t hash);
+
+private:
+    uint64_t _bucket_mask;
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_BLOOM_FILTER_H
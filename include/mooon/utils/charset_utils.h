@@ -22,8 +22,20 @@
 #include <errno.h>
 #include <iconv.h>
 #include <string.h>
+#include <string>
 UTILS_NAMESPACE_BEGIN
 
+/***
+  * 字符集转换
+  * 每个线程缓存最近使用的iconv_t（按源和目标字符集区分），不需要每次调用都iconv_open和iconv_close，
+  * 线程退出时自动关闭。
+  * 源和目标字符集都兼容ASCII（如gbk、gb2312、gb18030和utf-8）时，连续的ASCII字符直接复制，
+  * 只有非ASCII部分才交给iconv转换。
+  *
+  * UTF-8的校验、UTF-8和UTF-16的互转以及GBK转UTF-8不经过iconv：
+  * 校验以SIMD一次检查16或32字节（见CStringSimd::find_invalid_utf8），
+  * GBK的双字节字符查表（表在第一次使用时由iconv生成），连续的ASCII直接复制。
+  */
 class CCharsetUtils
 {
 public:
@@ -34,12 +46,46 @@ public:
     static void convert(const std::string& from_charset, const std::string& to_charset,
                  const std::string& from, std::string* to, bool ignore_error=true, bool skip_error=true);
 
+    // 转换到调用者提供的缓冲区to中，to不能和from重叠，不会添加结尾符
+    // to_size 输入时为to的大小，输出时为转换后的字节数
+    // to空间不足时抛出错误码为E2BIG的CException异常
+    static void convert(const std::string& from_charset, const std::string& to_charset,
+                 const char* from, size_t from_size, char* to, size_t* to_size, bool ignore_error=true, bool skip_error=true);
+
 public:
     static void gbk_to_utf8(const std::string& from, std::string* to, bool ignore_error=true, bool skip_error=true);
     static void utf8_to_gbk(const std::string& from, std::string* to, bool ignore_error=true, bool skip_error=true);
 
+    static void gbk_to_utf8(const char* from, size_t from_size, char* to, size_t* to_size, bool ignore_error=true, bool skip_error=true);
+    static void utf8_to_gbk(const char* from, size_t from_size, char* to, size_t* to_size, bool ignore_error=true, bool skip_error=true);
+
     static void gb2312_to_utf8(const std::string& from, std::string* to, bool ignore_error=true, bool skip_error=true);
     static void utf8_to_gb2312(const std::string& from, std::string* to, bool ignore_error=true, bool skip_error=true);
+
+public:
+    /***
+      * 判断是否为合法的UTF-8，如写入MySQL或Kafka前检查，
+      * 超长编码、代理项（U+D800至U+DFFF）、大于U+10FFFF的和结尾不完整的字符都不合法
+      * @error_offset: 不为NULL时，存储第一个不合法字符的首字节的偏移，合法时为size
+      */
+    static bool is_utf8(const char* str, size_t size, size_t* error_offset=NULL);
+    static bool is_utf8(const std::string& str, size_t* error_offset=NULL);
+
+    /***
+      * UTF-8转UTF-16（本机字节序），U+FFFF以上的转成代理对
+      * @to: 不能小于from_size个char16_t，返回写入的个数
+      * @exception: from不是合法的UTF-8时抛出错误码为EILSEQ的CException异常
+      */
+    static size_t utf8_to_utf16(const char* from, size_t from_size, char16_t* to);
+    static void utf8_to_utf16(const std::string& from, std::u16string* to);
+
+    /***
+      * UTF-16（本机字节序）转UTF-8
+      * @to: 不能小于from_size*3字节，返回写入的字节数
+      * @exception: from中有不成对的代理项时抛出错误码为EILSEQ的CException异常
+      */
+    static size_t utf16_to_utf8(const char16_t* from, size_t from_size, char* to);
+    static void utf16_to_utf8(const std::u16string& from, std::string* to);
 };
 
 UTILS_NAMESPACE_END
@@ -0,0 +1,159 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_CODEC_H
+#define MOOON_UTILS_CODEC_H
+#include "mooon/utils/config.h"
+#include <string>
+#include <sys/types.h>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * base64、十六进制和URL编解码，输出到调用者提供的缓冲区，不分配内存，
+  * x86_64上CPU支持AVX2时base64编解码和十六进制转换使用AVX2，URL编解码用查表
+  *
+  * base64使用标准字母表（RFC 4648，+和/），编码总是带=填充，解码时填充可有可无
+  */
+class CCodec
+{
+public:
+    /** 编码size字节后的字符数 */
+    static size_t base64_encoded_size(size_t size) { return (size + 2) / 3 * 4; }
+
+    /** 解码size个字符最多得到的字节数，也是解码时dest至少需要的大小 */
+    static size_t base64_decoded_size_max(size_t size) { return (size + 3) / 4 * 3 + 3; }
+
+    /***
+      * base64编码
+      * @dest: 至少base64_encoded_size(size)字节，不会写入结尾符
+      * @return: 写入dest的字符数
+      */
+    static size_t base64_encode(const void* src, size_t size, char* dest);
+
+    /***
+      * base64解码，不允许有空白字符（需要时使用CBase64Decoder）
+      * @dest: 至少base64_decoded_size_max(size)字节
+      * @return: 成功返回写入dest的字节数，src不是有效的base64时返回-1
+      */
+    static ssize_t base64_decode(const char* src, size_t size, void* dest);
+
+    static std::string base64_encode(const std::string& src);
+    static bool base64_decode(const std::string& src, std::string* dest);
+
+    /***
+      * 十六进制编码，同CStringUtils::to_hex
+      * @dest: 至少2*size字节，不会写入结尾符
+      */
+    static void hex_encode(const void* src, size_t size, char* dest, bool lowercase=true);
+
+    /***
+      * 十六进制解码，大小写均可
+      * @dest: 至少size/2字节
+      * @return: 成功返回写入dest的字节数，size为奇数或含非十六进制字符时返回-1
+      */
+    static ssize_t hex_decode(const char* src, size_t size, void* dest);
+
+    /***
+      * URL编码，RFC 3986的未保留字符（字母、数字和-_.~）不编码，其它字符编码成%XX
+      * @dest: 至少3*size字节，不会写入结尾符
+      * @space2plus: 为true时空格编码成+，否则编码成%20
+      * @return: 写入dest的字符数
+      */
+    static size_t url_encode(const char* src, size_t size, char* dest, bool space2plus=false);
+
+    /***
+      * URL解码，+解码成空格，%后不是两个十六进制字符时原样保留%
+      * @dest: 至少size字节，可以和src相同（原地解码）
+      * @return: 写入dest的字符数
+      */
+    static size_t url_decode(const char* src, size_t size, char* dest);
+
+    /** 判断是否使用了AVX2 */
+    static bool is_accelerated();
+
+    /** 为true时只使用标量实现，非线程安全，仅用于测试和性能对比 */
+    static void set_software_only(bool software_only);
+};
+
+/***
+  * 流式base64编码，用于分段编码大数据，结果同对整体调用CCodec::base64_encode
+  *
+  * 使用示例：
+  * CBase64Encoder encoder;
+  * while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+  *     output.append(out, encoder.update(buffer, n, out)); // out至少CCodec::base64_encoded_size(n+2)字节
+  * output.append(out, encoder.finish(out));
+  */
+class CBase64Encoder
+{
+public:
+    CBase64Encoder();
+
+    /***
+      * 编码一段数据，不足3字节的尾部留到下一次
+      * @dest: 至少CCodec::base64_encoded_size(size+2)字节
+      * @return: 写入dest的字符数
+      */
+    size_t update(const void* data, size_t size, char* dest);
+
+    /***
+      * 编码剩余的尾部并填充，之后可重新开始编码
+      * @dest: 至少4字节
+      */
+    size_t finish(char* dest);
+
+private:
+    unsigned char _carry[3];
+    size_t _carry_size;
+};
+
+/***
+  * 流式base64解码，跳过空白字符（如每76个字符一行的MIME格式中的换行），
+  * 一组4个字符可以跨两次update
+  */
+class CBase64Decoder
+{
+public:
+    CBase64Decoder();
+
+    /***
+      * 解码一段数据
+      * @dest: 至少CCodec::base64_decoded_size_max(size)字节
+      * @return: 成功返回写入dest的字节数，遇到无效字符返回-1，之后的调用都返回-1
+      */
+    ssize_t update(const char* data, size_t size, void* dest);
+
+    /***
+      * 结束解码，解码剩余的无填充尾部
+      * @dest: 至少3字节
+      * @return: 成功返回写入dest的字节数，剩余的字符无法构成有效的尾部时返回-1
+      */
+    ssize_t finish(void* dest);
+
+    /** 重新开始解码 */
+    void reset();
+
+private:
+    unsigned char _carry[4];
+    size_t _carry_size;
+    bool _finished; // 已遇到=填充，之后只允许空白字符
+    bool _failed;
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_CODEC_H
@@ -0,0 +1,219 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_COMPILED_FORMAT_H
+#define MOOON_UTILS_COMPILED_FORMAT_H
+#include "mooon/utils/config.h"
+#include <string>
+#include <vector>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 格式化结果的缓冲区，不超过inline_size时不分配内存，
+  * 可重复使用（clear后再格式化），以免每次格式化都分配内存
+  */
+class CFormatBuffer
+{
+public:
+    enum { inline_size = 512 };
+
+public:
+    CFormatBuffer();
+    ~CFormatBuffer();
+
+    void append(const char* str, size_t size);
+    void append(char c);
+    void append(const std::string& str) { append(str.data(), str.size()); }
+
+    /** 保证尾部至少还有size字节可写，返回尾部地址，写完后调用commit */
+    char* prepare(size_t size);
+    void commit(size_t size) { _size += size; }
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+    const char* c_str();
+    std::string str() const { return std::string(_data, _size); }
+    void clear() { _size = 0; }
+
+private:
+    CFormatBuffer(const CFormatBuffer&);
+    CFormatBuffer& operator =(const CFormatBuffer&);
+
+private:
+    char* _data;
+    size_t _size;
+    size_t _capacity;
+    char _inline_buffer[inline_size];
+};
+
+/***
+  * 类型擦除后的格式化参数，按参数的实际类型格式化，而不是按格式中的转换符，
+  * 因此类型不匹配时（如%d对应std::string）也不会出错，
+  * 字符串只保存指针，须在格式化完成前有效
+  */
+class CFormatArg
+{
+public:
+    enum arg_type_t { arg_none, arg_int, arg_uint, arg_double, arg_char, arg_string, arg_pointer };
+
+public:
+    CFormatArg(): _type(arg_none) { _value.int_value = 0; }
+    CFormatArg(bool value): _type(arg_int) { _value.int_value = value; }
+    CFormatArg(char value): _type(arg_char) { _value.int_value = value; }
+    CFormatArg(signed char value): _type(arg_int) { _value.int_value = value; }
+    CFormatArg(unsigned char value): _type(arg_uint) { _value.uint_value = value; }
+    CFormatArg(short value): _type(arg_int) { _value.int_value = value; }
+    CFormatArg(unsigned short value): _type(arg_uint) { _value.uint_value = value; }
+    CFormatArg(int value): _type(arg_int) { _value.int_value = value; }
+    CFormatArg(unsigned int value): _type(arg_uint) { _value.uint_value = value; }
+    CFormatArg(long value): _type(arg_int) { _value.int_value = value; }
+    CFormatArg(unsigned long value): _type(arg_uint) { _value.uint_value = value; }
+    CFormatArg(long long value): _type(arg_int) { _value.int_value = value; }
+    CFormatArg(unsigned long long value): _type(arg_uint) { _value.uint_value = value; }
+    CFormatArg(float value): _type(arg_double) { _value.double_value = value; }
+    CFormatArg(double value): _type(arg_double) { _value.double_value = value; }
+    CFormatArg(const char* value): _type(arg_string) { _value.string_value.str = (NULL == value)? "(null)": value; _value.string_value.size = -1; }
+    CFormatArg(const std::string& value): _type(arg_string) { _value.string_value.str = value.c_str(); _value.string_value.size = static_cast<int64_t>(value.size()); }
+    CFormatArg(const void* value): _type(arg_pointer) { _value.pointer_value = value; }
+
+    arg_type_t type() const { return _type; }
+    int64_t int_value() const { return _value.int_value; }
+    uint64_t uint_value() const { return _value.uint_value; }
+    double double_value() const { return _value.double_value; }
+    const char* string_value() const { return _value.string_value.str; }
+    const void* pointer_value() const { return _value.pointer_value; }
+
+    /** 字符串的长度，来自const char*时为-1，表示需要strlen */
+    int64_t string_size() const { return _value.string_value.size; }
+
+private:
+    arg_type_t _type;
+    union
+    {
+        int64_t int_value;
+        uint64_t uint_value;
+        double double_value;
+        const void* pointer_value;
+        struct
+        {
+            const char* str;
+            int64_t size;
+        } string_value;
+    } _value;
+};
+
+/***
+  * 预先解析好的printf风格格式，解析一次后可重复使用，
+  * 格式化时不再逐字符解析格式，整数和字符串等没有宽度和精度的转换直接写入缓冲区，
+  * 不经过snprintf，有宽度、精度或标志的转换（如%08.3f）仍由snprintf完成单个转换。
+  *
+  * 支持的转换符同printf（不支持%n和$位置参数），宽度和精度可为*，
+  * 长度修饰符（如l、ll、z）被忽略，因为按参数的实际类型格式化，
+  * 格式中的转换符比参数多时，多出的转换符不输出
+  *
+  * 使用示例：
+  * static const CCompiledFormat compiled_format("%s:%d");
+  * std::string str = compiled_format.format_string(ip, port);
+  * 或用MOOON_FORMAT_STRING，它在每个调用处缓存解析结果：
+  * std::string str = MOOON_FORMAT_STRING("%s:%d", ip, port);
+  */
+class CCompiledFormat
+{
+public:
+    explicit CCompiledFormat(const char* format);
+    explicit CCompiledFormat(const std::string& format);
+
+    /***
+      * 格式化追加到buffer
+      * @args: 参数数组
+      * @num_args: 参数个数
+      */
+    void format_to(CFormatBuffer* buffer, const CFormatArg* args, int num_args) const;
+
+#if __cplusplus >= 201103L
+    template <typename... Args>
+    void format_to(CFormatBuffer* buffer, const Args&... args) const
+    {
+        const CFormatArg arg_array[] = { CFormatArg(args)..., CFormatArg() };
+        format_to(buffer, arg_array, static_cast<int>(sizeof...(Args)));
+    }
+
+    template <typename... Args>
+    std::string format_string(const Args&... args) const
+    {
+        CFormatBuffer buffer;
+        format_to(&buffer, args...);
+        return buffer.str();
+    }
+#endif // __cplusplus >= 201103L
+
+    /** 得到格式中转换符的个数（不包括宽度和精度中的*） */
+    int get_conversion_number() const { return _conversion_number; }
+
+private:
+    struct Segment
+    {
+        bool literal;       // 为true时是普通字符，否则为转换
+        uint32_t offset;    // 在_format中的开始位置
+        uint32_t size;
+        char conversion;    // 转换符，如d、s
+        bool simple;        // 没有标志、宽度和精度
+        bool star_width;
+        bool star_precision;
+        int32_t width;      // -1表示没有
+        int32_t precision;  // -1表示没有
+        char flags[6];      // 以结尾符结束
+    };
+
+    void parse();
+    void format_conversion(CFormatBuffer* buffer, const Segment& segment, const CFormatArg& arg, int width, int precision) const;
+
+private:
+    std::string _format;
+    std::vector<Segment> _segments;
+    int _conversion_number;
+};
+
+#if __cplusplus >= 201103L
+/***
+  * 类型安全的format_string，每次调用都解析格式，
+  * 格式固定时应使用MOOON_FORMAT_STRING或复用CCompiledFormat
+  */
+template <typename... Args>
+inline std::string format_string(const char* format, const Args&... args)
+{
+    return CCompiledFormat(format).format_string(args...);
+}
+
+/** 解析结果缓存在调用处的静态变量中，format必须在每次调用时相同 */
+#define MOOON_FORMAT_STRING(format, ...) \
+    ([&]() -> std::string { \
+        static const ::mooon::utils::CCompiledFormat compiled_format__(format); \
+        return compiled_format__.format_string(__VA_ARGS__); \
+    }())
+
+/** 同MOOON_FORMAT_STRING，但追加到CFormatBuffer中 */
+#define MOOON_FORMAT_TO(buffer, format, ...) \
+    do { \
+        static const ::mooon::utils::CCompiledFormat compiled_format__(format); \
+        compiled_format__.format_to(buffer, ##__VA_ARGS__); \
+    } while (0)
+#endif // __cplusplus >= 201103L
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_COMPILED_FORMAT_H
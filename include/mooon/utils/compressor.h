@@ -0,0 +1,215 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_COMPRESSOR_H
+#define MOOON_UTILS_COMPRESSOR_H
+#include "mooon/utils/config.h"
+#include <string>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 压缩方式，gzip和zlib基于zlib（总是可用），
+  * zstd和lz4须在编译时找到对应的库（MOOON_HAVE_ZSTD和MOOON_HAVE_LZ4），否则创建时抛出异常
+  */
+typedef enum
+{
+    compression_none = 0, /** 不压缩，原样输出 */
+    compression_gzip = 1, /** gzip格式，可用“gzip -dc”解压，不支持字典 */
+    compression_zlib = 2, /** zlib格式（RFC 1950），支持字典 */
+    compression_zstd = 3, /** zstd帧格式，可用“zstd -dc”解压，支持字典 */
+    compression_lz4  = 4, /** lz4帧格式，可用“lz4 -dc”解压，不支持字典 */
+    compression_max  = 5
+}compression_t;
+
+/** 是否支持该压缩方式，zstd和lz4取决于编译时是否找到了库 */
+extern bool is_compression_supported(compression_t compression);
+
+/** 压缩方式的名字，即“none”、“gzip”、“zlib”、“zstd”或“lz4”，也是gzip、zstd和lz4的命令名 */
+extern const char* get_compression_name(compression_t compression);
+
+/***
+  * 由名字得到压缩方式，名字同get_compression_name
+  * @exception: 名字不对时抛出CException异常
+  */
+extern compression_t get_compression_by_name(const std::string& name);
+
+/** 压缩文件的后缀，如“.gz”，不压缩时为空字符串 */
+extern const char* get_compression_suffix(compression_t compression);
+
+/***
+  * 由数据开头的魔数识别压缩方式，能识别gzip、zstd和lz4（zlib没有可靠的魔数），
+  * 用于读取可能被压缩过的文件（如滚动后压缩的日志）
+  * @return: 不能识别时返回compression_none
+  */
+extern compression_t detect_compression(const char* data, size_t size);
+
+/***
+  * 流式压缩器，数据可分多次输入，输出追加到调用者的缓冲区中，
+  * 一个流以finish结束，之后reset开始新的流，复用已分配的上下文和已加载的字典，
+  * 频繁压缩小数据时应复用压缩器（或用get_thread_compressor），创建上下文的开销远大于压缩本身。
+  * 非线程安全。
+  *
+  * 使用示例（压缩CIoBuffer中的数据发送）：
+  * mooon::utils::CCompressor* compressor = mooon::utils::CCompressor::get_thread_compressor(mooon::utils::compression_zstd);
+  * compressor->compress_buffer(in, true, &out);
+  */
+class CCompressor
+{
+public:
+    /***
+      * @level: 压缩级别，-1为各自的默认值（gzip和zlib为6，zstd为3，lz4为0即快速模式）
+      * @dictionary: 预置字典，用于压缩内容相似的小数据（如单条消息），解压时须使用相同的字典
+      * @exception: 不支持的压缩方式或参数，或创建上下文失败时抛出CException异常
+      */
+    CCompressor(compression_t compression, int level=-1, const std::string& dictionary=std::string());
+    ~CCompressor();
+
+    compression_t get_compression() const { return _compression; }
+    int get_level() const { return _level; }
+
+    /***
+      * 输入数据，压缩后的数据追加到out，压缩器内部可能缓存部分数据，
+      * @exception: 出错时抛出CException异常
+      */
+    void compress(const char* data, size_t size, std::string* out);
+
+    /** 输出所有已输入数据的压缩结果，使接收方可以解出已输入的全部数据，流并不结束 */
+    void flush(std::string* out);
+
+    /** 结束当前的流，输出剩余的压缩数据和流尾 */
+    void finish(std::string* out);
+
+    /** 开始新的流，未finish的流被丢弃，保留上下文和字典 */
+    void reset();
+
+    /***
+      * 压缩链式缓冲区（如net::CIoBuffer，须有get_slice_number、get_slice和append）中的所有数据，
+      * 逐个片段输入，不先合并成连续的内存，结果追加到out
+      * @finish: 为true时结束流，否则只flush
+      */
+    template <class IoBuffer>
+    void compress_buffer(const IoBuffer& in, bool finish, IoBuffer* out)
+    {
+        _output.clear();
+        for (size_t i=0; i<in.get_slice_number(); ++i)
+        {
+            size_t size = 0;
+            const char* data = in.get_slice(i, &size);
+            compress(data, size, &_output);
+        }
+        if (finish)
+            this->finish(&_output);
+        else
+            flush(&_output);
+        out->append(_output.data(), _output.size());
+    }
+
+    /***
+      * 得到本线程的压缩器，不带字典，同一线程内复用，线程退出时自动销毁，调用者不能delete，
+      * 返回前已reset
+      * @exception: 同构造函数
+      */
+    static CCompressor* get_thread_compressor(compression_t compression, int level=-1);
+
+public:
+    struct Backend;
+
+private:
+    CCompressor(const CCompressor&);
+    CCompressor& operator =(const CCompressor&);
+
+private:
+    const compression_t _compression;
+    const int _level;
+    Backend* _backend;
+    std::string _output; // compress_buffer的临时输出
+};
+
+/***
+  * 流式解压器，和CCompressor对应，gzip和zlib格式自动识别（两者可用同一个解压器），
+  * 一个流结束后又有输入时，当作下一个流（如拼接的gzip文件或多个zstd帧）继续解压。
+  * 非线程安全。
+  */
+class CDecompressor
+{
+public:
+    /***
+      * @dictionary: 须和压缩时使用的字典相同
+      * @exception: 不支持的压缩方式，或创建上下文失败时抛出CException异常
+      */
+    CDecompressor(compression_t compression, const std::string& dictionary=std::string());
+    ~CDecompressor();
+
+    compression_t get_compression() const { return _compression; }
+
+    /***
+      * 输入压缩的数据，解出的数据追加到out，数据可以在任意位置分段
+      * @return: 输入是否恰好在流的结尾处结束，可用于判断数据是否完整
+      * @exception: 数据损坏或字典不对时抛出CException异常
+      */
+    bool decompress(const char* data, size_t size, std::string* out);
+
+    /** 丢弃未解完的流，保留上下文和字典 */
+    void reset();
+
+    /** 解压链式缓冲区中的所有数据，结果追加到out，返回值同decompress */
+    template <class IoBuffer>
+    bool decompress_buffer(const IoBuffer& in, IoBuffer* out)
+    {
+        bool finished = (0 == in.get_slice_number());
+        _output.clear();
+        for (size_t i=0; i<in.get_slice_number(); ++i)
+        {
+            size_t size = 0;
+            const char* data = in.get_slice(i, &size);
+            finished = decompress(data, size, &_output);
+        }
+        out->append(_output.data(), _output.size());
+        return finished;
+    }
+
+    /** 得到本线程的解压器，不带字典，调用者不能delete，返回前已reset */
+    static CDecompressor* get_thread_decompressor(compression_t compression);
+
+public:
+    struct Backend;
+
+private:
+    CDecompressor(const CDecompressor&);
+    CDecompressor& operator =(const CDecompressor&);
+
+private:
+    const compression_t _compression;
+    Backend* _backend;
+    std::string _output;
+};
+
+/***
+  * 以本线程的压缩器一次压缩一段数据，结果追加到out
+  * @exception: 出错时抛出CException异常
+  */
+extern void compress_data(compression_t compression, const char* data, size_t size, std::string* out, int level=-1);
+
+/***
+  * 以本线程的解压器一次解压一段完整的数据，结果追加到out
+  * @exception: 数据损坏或不完整时抛出CException异常
+  */
+extern void decompress_data(compression_t compression, const char* data, size_t size, std::string* out);
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_COMPRESSOR_H
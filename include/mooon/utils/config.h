@@ -125,6 +125,11 @@ MOOON_NAMESPACE_END
 #define	LINE_MAX 1024
 #endif
 
+/** CPU缓存行字节数，用于避免伪共享（false sharing） */
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 /** IO操作通用缓冲区大小 */
 #ifdef IO_BUFFER_MAX
 #undef IO_BUFFER_MAX
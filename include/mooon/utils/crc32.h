@@ -0,0 +1,73 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_CRC32_H
+#define MOOON_UTILS_CRC32_H
+#include "mooon/utils/config.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 32位CRC，支持两种多项式，不同多项式的结果不同，不能混用：
+  * 1) poly_ieee，即0x04C11DB7，结果同zlib的crc32，支持PCLMULQDQ时用其折叠计算
+  * 2) poly_castagnoli，即CRC32C（0x1EDC6F41），支持SSE4.2时用crc32指令计算
+  * 不支持相应指令时使用slice-by-8软件实现，结果相同
+  *
+  * 流式计算示例：
+  * CCrc32 crc32(CCrc32::poly_castagnoli);
+  * crc32.update(data1, size1);
+  * crc32.update(data2, size2);
+  * const uint32_t crc = crc32.get_value();
+  */
+class CCrc32
+{
+public:
+    typedef enum
+    {
+        poly_ieee = 0,      // zlib、gzip、png等使用的CRC32
+        poly_castagnoli = 1 // iSCSI、ext4等使用的CRC32C
+    }polynomial_t;
+
+public:
+    /***
+      * @crc: 初始值，为之前数据的CRC值，从头计算时为0
+      */
+    explicit CCrc32(polynomial_t polynomial=poly_ieee, uint32_t crc=0);
+    void reset(uint32_t crc=0) { _crc = crc; }
+    void update(const void* data, size_t size);
+    uint32_t get_value() const { return _crc; }
+    polynomial_t get_polynomial() const { return _polynomial; }
+
+public:
+    /** 一次性计算，crc为之前数据的CRC值 */
+    static uint32_t checksum(polynomial_t polynomial, const void* data, size_t size, uint32_t crc=0);
+    static uint32_t crc32(const void* data, size_t size, uint32_t crc=0);
+    static uint32_t crc32c(const void* data, size_t size, uint32_t crc=0);
+
+    /** 判断指定多项式是否使用了硬件指令 */
+    static bool is_hardware_accelerated(polynomial_t polynomial);
+
+    /** 为true时只使用软件实现，非线程安全，仅用于测试和性能对比 */
+    static void set_software_only(bool software_only);
+
+private:
+    polynomial_t _polynomial;
+    uint32_t _crc;
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_CRC32_H
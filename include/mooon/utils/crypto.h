@@ -3,11 +3,10 @@
 #define MOOON_UTILS_CRYPTO_H
 #include "mooon/utils/config.h"
 UTILS_NAMESPACE_BEGIN
-#if MOOON_HAVE_OPENSSL == 1
 
+// 基于CCodec实现，不再依赖OpenSSL，直接操作缓冲区或分段编解码使用codec.h
 void base64_encode(const std::string& src, std::string* dest, bool no_newline=true);
 void base64_decode(const std::string& src, std::string* dest, bool no_newline=true);
 
-#endif // MOOON_HAVE_OPENSSL
 UTILS_NAMESPACE_END
 #endif // MOOON_UTILS_CRYPTO_H
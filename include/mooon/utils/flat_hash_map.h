@@ -0,0 +1,483 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_FLAT_HASH_MAP_H
+#define MOOON_UTILS_FLAT_HASH_MAP_H
+#include "mooon/utils/hash_utils.h"
+#include <functional>
+#include <new>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 开放寻址的哈希表，SwissTable的方式：
+  * 1) 元素直接存放在一个数组中，不像std::map和std::unordered_map那样每个元素一个节点；
+  * 2) 另有一个控制字节数组，每个槽位一个字节，记录槽位是空、已删除还是有元素，
+  *    有元素时存放哈希值的低7位，查找时一次用SSE2比较16个控制字节，
+  *    只有控制字节匹配的槽位才比较key，绝大多数查找只访问一到两个缓存行。
+  * 负载因子不超过7/8，删除时留下删除标记，删除标记多时原地重建。
+  *
+  * 插入和重建会使迭代器、指针和引用失效，这点不同于std::unordered_map。
+  * 一般不直接使用，而是使用CFlatHashMap和CFlatHashSet。
+  */
+template <typename Slot, typename Key, typename KeyOf, typename Hash, typename Equal>
+class CFlatHashTable
+{
+public:
+    typedef Key key_type;
+    typedef Slot value_type;
+    typedef size_t size_type;
+
+    // 控制字节的取值，有元素时为0~127
+    enum
+    {
+        ctrl_empty = -128,  // 0x80
+        ctrl_deleted = -2,  // 0xFE
+        group_width = 16
+    };
+
+    template <typename TableType, typename SlotType>
+    class Iterator
+    {
+    public:
+        Iterator()
+            : _table(NULL), _index(0)
+        {
+        }
+
+        Iterator(TableType* table, size_t index)
+            : _table(table), _index(index)
+        {
+            skip();
+        }
+
+        // 允许从iterator转成const_iterator
+        template <typename OtherTable, typename OtherSlot>
+        Iterator(const Iterator<OtherTable, OtherSlot>& other)
+            : _table(other._table), _index(other._index)
+        {
+        }
+
+        SlotType& operator *() const { return _table->_slots[_index]; }
+        SlotType* operator ->() const { return &_table->_slots[_index]; }
+        Iterator& operator ++() { ++_index; skip(); return *this; }
+        Iterator operator ++(int) { Iterator iter = *this; ++*this; return iter; }
+        bool operator ==(const Iterator& other) const { return _index == other._index; }
+        bool operator !=(const Iterator& other) const { return _index != other._index; }
+
+    private:
+        void skip()
+        {
+            while ((_index < _table->_capacity) && (_table->_ctrl[_index] < 0))
+                ++_index;
+        }
+
+    private:
+        template <typename, typename, typename, typename, typename> friend class CFlatHashTable;
+        template <typename, typename> friend class Iterator;
+        TableType* _table;
+        size_t _index;
+    };
+
+    typedef Iterator<CFlatHashTable, Slot> iterator;
+    typedef Iterator<const CFlatHashTable, const Slot> const_iterator;
+
+public:
+    CFlatHashTable()
+        : _ctrl(empty_group()), _slots(NULL), _capacity(0), _size(0), _growth_left(0)
+    {
+    }
+
+    CFlatHashTable(const CFlatHashTable& other)
+        : _ctrl(empty_group()), _slots(NULL), _capacity(0), _size(0), _growth_left(0), _hasher(other._hasher), _equal(other._equal)
+    {
+        reserve(other._size);
+        for (const_iterator iter=other.begin(); iter!=other.end(); ++iter)
+            insert_unique(*iter);
+    }
+
+    CFlatHashTable& operator =(const CFlatHashTable& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            reserve(other._size);
+            for (const_iterator iter=other.begin(); iter!=other.end(); ++iter)
+                insert_unique(*iter);
+        }
+        return *this;
+    }
+
+#if __cplusplus >= 201103L
+    CFlatHashTable(CFlatHashTable&& other)
+        : _ctrl(empty_group()), _slots(NULL), _capacity(0), _size(0), _growth_left(0)
+    {
+        swap(other);
+    }
+
+    CFlatHashTable& operator =(CFlatHashTable&& other)
+    {
+        swap(other);
+        return *this;
+    }
+#endif // __cplusplus >= 201103L
+
+    ~CFlatHashTable()
+    {
+        destroy();
+    }
+
+    void swap(CFlatHashTable& other)
+    {
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_growth_left, other._growth_left);
+        std::swap(_hasher, other._hasher);
+        std::swap(_equal, other._equal);
+    }
+
+    size_t size() const { return _size; }
+    bool empty() const { return 0 == _size; }
+    size_t capacity() const { return _capacity; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, _capacity); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, _capacity); }
+
+    iterator find(const Key& key)
+    {
+        return iterator(this, find_index(key));
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        return const_iterator(this, find_index(key));
+    }
+
+    size_t count(const Key& key) const
+    {
+        return (find_index(key) < _capacity)? 1: 0;
+    }
+
+    /** 已存在时不插入，返回已存在的元素 */
+    std::pair<iterator, bool> insert(const Slot& slot)
+    {
+        const size_t hash = hash_of(KeyOf()(slot));
+        size_t index = find_index(KeyOf()(slot), hash);
+        if (index < _capacity)
+            return std::make_pair(iterator(this, index), false);
+
+        index = prepare_insert(hash);
+        new (_slots+index) Slot(slot);
+        return std::make_pair(iterator(this, index), true);
+    }
+
+    size_t erase(const Key& key)
+    {
+        const size_t index = find_index(key);
+        if (index >= _capacity)
+            return 0;
+
+        erase_index(index);
+        return 1;
+    }
+
+    void erase(iterator iter)
+    {
+        erase_index(iter._index);
+    }
+
+    void clear()
+    {
+        for (size_t i=0; i<_capacity; ++i)
+        {
+            if (_ctrl[i] >= 0)
+                _slots[i].~Slot();
+        }
+        if (_capacity > 0)
+        {
+            memset(_ctrl, ctrl_empty, _capacity + group_width);
+            _growth_left = max_load(_capacity);
+        }
+        _size = 0;
+    }
+
+    /** 预留至少可容纳size个元素的空间，避免插入过程中多次重建 */
+    void reserve(size_t size)
+    {
+        if (size > _size + _growth_left)
+        {
+            size_t capacity = group_width;
+            while (max_load(capacity) < size)
+                capacity *= 2;
+            rehash(capacity);
+        }
+    }
+
+protected:
+    // 找到可插入的槽位，需要时扩容，返回的槽位已设置好控制字节
+    size_t prepare_insert(size_t hash)
+    {
+        size_t index = find_first_non_full(hash);
+        if ((0 == _growth_left) && (_ctrl[index] != ctrl_deleted))
+        {
+            // 删除标记占了一半以上时原地重建即可，否则扩容
+            rehash(((_capacity > 0) && (_size * 2 < max_load(_capacity)))? _capacity: std::max<size_t>(_capacity * 2, group_width));
+            index = find_first_non_full(hash);
+        }
+
+        if (_ctrl[index] == ctrl_empty)
+            --_growth_left;
+        set_ctrl(index, static_cast<int8_t>(hash & 0x7F));
+        ++_size;
+        return index;
+    }
+
+    size_t hash_of(const Key& key) const
+    {
+        // 二次混合，使std::hash等较弱的哈希函数（如整数的恒等映射）也能均匀分布
+        return static_cast<size_t>(CHashUtils::mix64(static_cast<uint64_t>(_hasher(key))));
+    }
+
+    size_t find_index(const Key& key) const
+    {
+        return find_index(key, hash_of(key));
+    }
+
+    size_t find_index(const Key& key, size_t hash) const
+    {
+        if (0 == _capacity)
+            return 0;
+
+        const size_t mask = _capacity - 1;
+        const int8_t h2 = static_cast<int8_t>(hash & 0x7F);
+        size_t pos = (hash >> 7) & mask;
+
+        for (size_t probe=group_width; ; probe+=group_width)
+        {
+            for (uint32_t match=match_byte(_ctrl+pos, h2); match!=0; match&=match-1)
+            {
+                const size_t index = (pos + __builtin_ctz(match)) & mask;
+                if (_equal(KeyOf()(_slots[index]), key))
+                    return index;
+            }
+            if (match_byte(_ctrl+pos, ctrl_empty) != 0)
+                return _capacity; // 遇到空位，说明不存在
+
+            pos = (pos + probe) & mask; // 以组为单位的三角探测，可遍历所有组
+        }
+    }
+
+private:
+    static int8_t* empty_group()
+    {
+        static int8_t group[group_width] = {
+            ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty,
+            ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty, ctrl_empty };
+        return group;
+    }
+
+    static size_t max_load(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    // 返回16个控制字节中等于value的位图
+    static uint32_t match_byte(const int8_t* ctrl, int8_t value)
+    {
+#if defined(__SSE2__)
+        const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value))));
+#else
+        uint32_t mask = 0;
+        for (int i=0; i<group_width; ++i)
+            mask |= static_cast<uint32_t>(ctrl[i] == value) << i;
+        return mask;
+#endif // __SSE2__
+    }
+
+    // 返回16个控制字节中为空或已删除（最高位为1）的位图
+    static uint32_t match_non_full(const int8_t* ctrl)
+    {
+#if defined(__SSE2__)
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))));
+#else
+        uint32_t mask = 0;
+        for (int i=0; i<group_width; ++i)
+            mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+        return mask;
+#endif // __SSE2__
+    }
+
+    size_t find_first_non_full(size_t hash) const
+    {
+        if (0 == _capacity)
+            return 0;
+
+        const size_t mask = _capacity - 1;
+        size_t pos = (hash >> 7) & mask;
+        for (size_t probe=group_width; ; probe+=group_width)
+        {
+            const uint32_t match = match_non_full(_ctrl+pos);
+            if (match != 0)
+                return (pos + __builtin_ctz(match)) & mask;
+            pos = (pos + probe) & mask;
+        }
+    }
+
+    // 控制字节数组多出group_width个字节，是开头group_width个字节的副本，
+    // 使得从任意位置都可以连续读取一组
+    void set_ctrl(size_t index, int8_t value)
+    {
+        _ctrl[index] = value;
+        if (index < group_width)
+            _ctrl[_capacity + index] = value;
+    }
+
+    void erase_index(size_t index)
+    {
+        _slots[index].~Slot();
+        set_ctrl(index, ctrl_deleted);
+        --_size;
+    }
+
+    void insert_unique(const Slot& slot)
+    {
+        const size_t index = prepare_insert(hash_of(KeyOf()(slot)));
+        new (_slots+index) Slot(slot);
+    }
+
+    void rehash(size_t capacity)
+    {
+        int8_t* old_ctrl = _ctrl;
+        Slot* old_slots = _slots;
+        const size_t old_capacity = _capacity;
+
+        _ctrl = new int8_t[capacity + group_width];
+        _slots = static_cast<Slot*>(::operator new(capacity * sizeof(Slot)));
+        _capacity = capacity;
+        _growth_left = max_load(capacity) - _size;
+        memset(_ctrl, ctrl_empty, capacity + group_width);
+
+        for (size_t i=0; i<old_capacity; ++i)
+        {
+            if (old_ctrl[i] >= 0)
+            {
+                const size_t hash = hash_of(KeyOf()(old_slots[i]));
+                const size_t index = find_first_non_full(hash);
+                set_ctrl(index, static_cast<int8_t>(hash & 0x7F));
+#if __cplusplus >= 201103L
+                new (_slots+index) Slot(static_cast<Slot&&>(old_slots[i]));
+#else
+                new (_slots+index) Slot(old_slots[i]);
+#endif // __cplusplus >= 201103L
+                old_slots[i].~Slot();
+            }
+        }
+
+        if (old_capacity > 0)
+        {
+            delete []old_ctrl;
+            ::operator delete(old_slots);
+        }
+    }
+
+    void destroy()
+    {
+        if (_capacity > 0)
+        {
+            clear();
+            delete []_ctrl;
+            ::operator delete(_slots);
+        }
+    }
+
+protected:
+    int8_t* _ctrl;
+    Slot* _slots;
+    size_t _capacity;    // 槽位数，为0或16以上的2的幂
+    size_t _size;
+    size_t _growth_left; // 还可在空位上插入的元素个数
+    Hash _hasher;
+    Equal _equal;
+};
+
+template <typename Key, typename Value>
+struct FlatMapKeyOf
+{
+    const Key& operator ()(const std::pair<Key, Value>& slot) const { return slot.first; }
+};
+
+template <typename Key>
+struct FlatSetKeyOf
+{
+    const Key& operator ()(const Key& key) const { return key; }
+};
+
+/***
+  * 开放寻址的哈希map，接口为std::unordered_map的常用子集，
+  * 元素类型为std::pair<Key, Value>而不是std::pair<const Key, Value>，不要通过迭代器修改key
+  *
+  * 使用示例：
+  * CFlatHashMap<std::string, int> map;
+  * map["a"] = 1;
+  * CFlatHashMap<std::string, int>::const_iterator iter = map.find("a");
+  */
+template <typename Key, typename Value, typename Hash=std::hash<Key>, typename Equal=std::equal_to<Key> >
+class CFlatHashMap: public CFlatHashTable<std::pair<Key, Value>, Key, FlatMapKeyOf<Key, Value>, Hash, Equal>
+{
+    typedef CFlatHashTable<std::pair<Key, Value>, Key, FlatMapKeyOf<Key, Value>, Hash, Equal> Base;
+
+public:
+    typedef Value mapped_type;
+
+    Value& operator [](const Key& key)
+    {
+        const size_t hash = Base::hash_of(key);
+        size_t index = Base::find_index(key, hash);
+        if (index >= Base::_capacity)
+        {
+            index = Base::prepare_insert(hash);
+            new (Base::_slots+index) std::pair<Key, Value>(key, Value());
+        }
+        return Base::_slots[index].second;
+    }
+
+    /** 已存在时不覆盖 */
+    std::pair<typename Base::iterator, bool> insert(const Key& key, const Value& value)
+    {
+        return Base::insert(std::pair<Key, Value>(key, value));
+    }
+
+    using Base::insert;
+};
+
+/** 开放寻址的哈希set，接口为std::unordered_set的常用子集 */
+template <typename Key, typename Hash=std::hash<Key>, typename Equal=std::equal_to<Key> >
+class CFlatHashSet: public CFlatHashTable<Key, Key, FlatSetKeyOf<Key>, Hash, Equal>
+{
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_FLAT_HASH_MAP_H
@@ -20,7 +20,7 @@
  */
 #ifndef MOOON_UTILS_FUNCTION_H
 #define MOOON_UTILS_FUNCTION_H
-#include "mooon/utils/config.h"
+#include "mooon/utils/function_storage.h"
 #include <stdint.h>
 #include <stdio.h>
 UTILS_NAMESPACE_BEGIN
@@ -35,6 +35,9 @@ class Function
 public:
     virtual ~Function() {}
     virtual ReturnType operator ()() = 0;
+
+    // 由CFunctionStorage实现，用于移动内联存储的函数对象
+    virtual Function* move_to(void* buffer) { return NULL; }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -327,122 +330,130 @@ private:
 };
 
 ////////////////////////////////////////////////////////////////////////////////
+/***
+  * bind的结果，函数对象不超过FUNCTOR_INLINE_SIZE时内联存储，不从堆上分配（见CFunctionStorage），
+  * 只能移动：复制构造和赋值也是转移（同std::auto_ptr），被复制的变为空
+  */
 template <typename ReturnType>
 class Functor
 {
 public:
     Functor()
-        : _function(NULL)
     {
     }
 
     Functor(const Functor& other)
     {
-        _function = other._function;
-        
-        Functor& mutable_other = const_cast<Functor&>(other);
-        mutable_other._function = NULL;
+        _storage.move_from(&const_cast<Functor&>(other)._storage);
     }
 
-    ~Functor()
+    Functor(Functor&& other) noexcept
     {
-        delete _function;
+        _storage.move_from(&other._storage);
     }
 
     Functor& operator =(const Functor& other)
     {
-        _function = other._function;
-        
-        Functor& mutable_other = const_cast<Functor&>(other);
-        mutable_other._function = NULL;
+        _storage.move_from(&const_cast<Functor&>(other)._storage);
+        return *this;
+    }
 
+    Functor& operator =(Functor&& other) noexcept
+    {
+        _storage.move_from(&other._storage);
         return *this;
     }
-    
+
     ReturnType operator ()()
     {
-        return (*_function)();
+        return (*_storage.get())();
     }
 
+    /** 是否为空，即默认构造的或已被转移的 */
+    bool empty() const { return NULL == _storage.get(); }
+
+    /** 函数对象是否内联存储 */
+    bool is_inline() const { return _storage.is_inline(); }
+
     // 不带参数
     Functor(typename FunctionWithoutParameter<ReturnType>::FunctionPtr function_ptr)
     {
-        _function = new FunctionWithoutParameter<ReturnType>(function_ptr);
+        _storage.template create<FunctionWithoutParameter<ReturnType> >(function_ptr);
     }
 
     template <class ObjectType>
     Functor(typename MemberFunctionWithoutParameter<ReturnType, ObjectType>::MemberFunctionPtr member_function_ptr, ObjectType* object)
     {
-        _function = new MemberFunctionWithoutParameter<ReturnType, ObjectType>(member_function_ptr, object);
+        _storage.template create<MemberFunctionWithoutParameter<ReturnType, ObjectType> >(member_function_ptr, object);
     }
    
     // 带1个参数
     template < typename ParameterType>
     Functor(typename FunctionWith1Parameter<ReturnType, ParameterType>::FunctionPtr function_ptr, ParameterType parameter)
     {
-        _function = new FunctionWith1Parameter<ReturnType, ParameterType>(function_ptr, parameter);
+        _storage.template create<FunctionWith1Parameter<ReturnType, ParameterType> >(function_ptr, parameter);
     }
 
     template <class ObjectType, typename ParameterType>
     Functor(typename MemberFunctionWith1Parameter<ReturnType, ObjectType, ParameterType>::MemberFunctionPtr member_function_ptr, ObjectType* object, ParameterType parameter)
     {
-        _function = new MemberFunctionWith1Parameter<ReturnType, ObjectType, ParameterType>(member_function_ptr, object, parameter);
+        _storage.template create<MemberFunctionWith1Parameter<ReturnType, ObjectType, ParameterType> >(member_function_ptr, object, parameter);
     }
 
     // 带2个参数
     template <typename Parameter1Type, typename Parameter2Type>
     Functor(typename FunctionWith2Parameter<ReturnType, Parameter1Type, Parameter2Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2)
     {
-        _function = new FunctionWith2Parameter<ReturnType, Parameter1Type, Parameter2Type>(function_ptr, parameter1, parameter2);
+        _storage.template create<FunctionWith2Parameter<ReturnType, Parameter1Type, Parameter2Type> >(function_ptr, parameter1, parameter2);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type>
     Functor(typename MemberFunctionWith2Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2)
     {
-        _function = new MemberFunctionWith2Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type>(member_function_ptr, object, parameter1, parameter2);
+        _storage.template create<MemberFunctionWith2Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type> >(member_function_ptr, object, parameter1, parameter2);
     }
 
     // 带3个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type>
     Functor(typename FunctionWith3Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3)
     {
-        _function = new FunctionWith3Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type>(function_ptr, parameter1, parameter2, parameter3);
+        _storage.template create<FunctionWith3Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type> >(function_ptr, parameter1, parameter2, parameter3);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type>
     Functor(typename MemberFunctionWith3Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3)
     {
-        _function = new MemberFunctionWith3Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type>(member_function_ptr, object, parameter1, parameter2, parameter3);
+        _storage.template create<MemberFunctionWith3Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type> >(member_function_ptr, object, parameter1, parameter2, parameter3);
     }
 
     // 带4个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type>
     Functor(typename FunctionWith4Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4)
     {
-        _function = new FunctionWith4Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>(function_ptr, parameter1, parameter2, parameter3, parameter4);
+        _storage.template create<FunctionWith4Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type>
     Functor(typename MemberFunctionWith4Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4)
     {
-        _function = new MemberFunctionWith4Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4);
+        _storage.template create<MemberFunctionWith4Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4);
     }
 
     // 带5个参数
     template <typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type>
     Functor(typename FunctionWith5Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>::FunctionPtr function_ptr, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5)
     {
-        _function = new FunctionWith5Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5);
+        _storage.template create<FunctionWith5Parameter<ReturnType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type> >(function_ptr, parameter1, parameter2, parameter3, parameter4, parameter5);
     }
 
     template <class ObjectType, typename Parameter1Type, typename Parameter2Type, typename Parameter3Type, typename Parameter4Type, typename Parameter5Type>
     Functor(typename MemberFunctionWith5Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>::MemberFunctionPtr member_function_ptr, ObjectType* object, Parameter1Type parameter1, Parameter2Type parameter2, Parameter3Type parameter3, Parameter4Type parameter4, Parameter5Type parameter5)
     {
-        _function = new MemberFunctionWith5Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type>(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5);
+        _storage.template create<MemberFunctionWith5Parameter<ReturnType, ObjectType, Parameter1Type, Parameter2Type, Parameter3Type, Parameter4Type, Parameter5Type> >(member_function_ptr, object, parameter1, parameter2, parameter3, parameter4, parameter5);
     }
 
-public:
-    Function<ReturnType>* _function;
+private:
+    CFunctionStorage<Function<ReturnType> > _storage;
 };
 
 UTILS_NAMESPACE_END
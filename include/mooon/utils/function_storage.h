@@ -0,0 +1,137 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_FUNCTION_STORAGE_H
+#define MOOON_UTILS_FUNCTION_STORAGE_H
+#include "mooon/utils/config.h"
+#include <new>
+#include <utility>
+UTILS_NAMESPACE_BEGIN
+
+// Functor的内联存储大小（含虚表指针），bind的函数指针、对象指针和参数合计不超过它时不从堆上分配，
+// 如成员函数指针（16字节）、对象指针和两个指针参数
+#define FUNCTOR_INLINE_SIZE 48
+
+/***
+  * utils::Functor和sys::Functor的小对象存储：
+  * 绑定的函数对象不超过InlineSize且对齐不超过16字节时，直接构造在内部的缓冲区中，否则new，
+  * 移动内联的对象时调用BaseType::move_to在目标缓冲区中移动构造，所以BaseType须声明：
+  * virtual BaseType* move_to(void* buffer);
+  * 只有内联存储的（即本类中的Inline）才会被调用，从堆上分配的直接转移指针。
+  */
+template <class BaseType, size_t InlineSize=FUNCTOR_INLINE_SIZE>
+class CFunctionStorage
+{
+public:
+    CFunctionStorage()
+        : _function(NULL), _inline(false)
+    {
+    }
+
+    ~CFunctionStorage()
+    {
+        reset();
+    }
+
+    /** 构造FunctionType(args...)，之前的被销毁 */
+    template <class FunctionType, typename... Args>
+    void create(Args&&... args)
+    {
+        reset();
+        // 编译期选择，放不下的分支不实例化，否则placement new会被-Wplacement-new告警
+        if constexpr ((sizeof(Inline<FunctionType>) <= InlineSize) && (__alignof__(Inline<FunctionType>) <= __alignof__(_buffer)))
+        {
+            _function = new (_buffer) Inline<FunctionType>(std::forward<Args>(args)...);
+            _inline = true;
+        }
+        else
+        {
+            _function = new FunctionType(std::forward<Args>(args)...);
+            _inline = false;
+        }
+    }
+
+    /** 将other的函数对象移到这里，other变为空，之前的被销毁 */
+    void move_from(CFunctionStorage* other)
+    {
+        if (this == other)
+            return;
+
+        reset();
+        if (other->_inline)
+        {
+            _function = other->_function->move_to(_buffer);
+            _inline = true;
+            other->reset();
+        }
+        else
+        {
+            _function = other->_function;
+            _inline = false;
+            other->_function = NULL;
+        }
+    }
+
+    /** 销毁函数对象 */
+    void reset()
+    {
+        if (_inline)
+            _function->~BaseType();
+        else
+            delete _function;
+        _function = NULL;
+        _inline = false;
+    }
+
+    BaseType* get() const { return _function; }
+    bool is_inline() const { return _inline; }
+
+private:
+    CFunctionStorage(const CFunctionStorage&);
+    CFunctionStorage& operator =(const CFunctionStorage&);
+
+    // 为内联的函数对象加上移动构造到另一个缓冲区的能力
+    template <class FunctionType>
+    class Inline: public FunctionType
+    {
+    public:
+        template <typename... Args>
+        Inline(Args&&... args)
+            : FunctionType(std::forward<Args>(args)...)
+        {
+        }
+
+        Inline(Inline&& other)
+            : FunctionType(static_cast<FunctionType&&>(other))
+        {
+        }
+
+        virtual BaseType* move_to(void* buffer)
+        {
+            return new (buffer) Inline(static_cast<Inline&&>(*this));
+        }
+    };
+
+private:
+    BaseType* _function;
+    bool _inline;
+    char _buffer[InlineSize] __attribute__((aligned(16)));
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_FUNCTION_STORAGE_H
@@ -19,6 +19,9 @@
 #ifndef MOOON_UTILS_HASH_UTILS_H
 #define MOOON_UTILS_HASH_UTILS_H
 #include "mooon/utils/config.h"
+#include <algorithm>
+#include <math.h>
+#include <vector>
 UTILS_NAMESPACE_BEGIN
 
 /** 求128类型的hash函数 */
@@ -26,7 +29,9 @@ struct uint128_hasher
 {
 	size_t operator ()(const uint8_t* data) const
     {
-		return *((size_t*)(data+4));
+	    size_t hash; // data不一定按8字节对齐
+	    memcpy(&hash, data+4, sizeof(hash));
+		return hash;
 	}
 };
 	
@@ -39,5 +44,345 @@ struct uint128_comparer
 	}
 };
 
+/***
+  * 非加密哈希和分片函数，均不依赖平台，相同输入在任何机器上结果相同，
+  * 可用于持久化的路由，但不能用于安全相关的场合
+  */
+class CHashUtils
+{
+public:
+    /***
+      * 64位的xxHash（XXH64），结果与官方实现相同
+      * @seed: 种子，不同种子得到相互独立的哈希
+      */
+    static uint64_t xxhash64(const void* data, size_t size, uint64_t seed=0)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + size;
+        uint64_t hash;
+
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + prime64_1 + prime64_2;
+            uint64_t v2 = seed + prime64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - prime64_1;
+
+            for (; p+32<=end; p+=32)
+            {
+                v1 = xxh64_round(v1, read64(p));
+                v2 = xxh64_round(v2, read64(p+8));
+                v3 = xxh64_round(v3, read64(p+16));
+                v4 = xxh64_round(v4, read64(p+24));
+            }
+
+            hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+            hash = xxh64_merge_round(hash, v1);
+            hash = xxh64_merge_round(hash, v2);
+            hash = xxh64_merge_round(hash, v3);
+            hash = xxh64_merge_round(hash, v4);
+        }
+        else
+        {
+            hash = seed + prime64_5;
+        }
+
+        hash += static_cast<uint64_t>(size);
+        for (; p+8<=end; p+=8)
+        {
+            hash ^= xxh64_round(0, read64(p));
+            hash = rotl64(hash, 27) * prime64_1 + prime64_4;
+        }
+        if (p+4 <= end)
+        {
+            hash ^= static_cast<uint64_t>(read32(p)) * prime64_1;
+            hash = rotl64(hash, 23) * prime64_2 + prime64_3;
+            p += 4;
+        }
+        for (; p<end; ++p)
+        {
+            hash ^= (*p) * prime64_5;
+            hash = rotl64(hash, 11) * prime64_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= prime64_2;
+        hash ^= hash >> 29;
+        hash *= prime64_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    static uint64_t xxhash64(const std::string& str, uint64_t seed=0)
+    {
+        return xxhash64(str.data(), str.size(), seed);
+    }
+
+    /** 编译期确定种子的xxhash64，如xxhash64<0x5EED>(data, size) */
+    template <uint64_t Seed>
+    static uint64_t xxhash64(const void* data, size_t size)
+    {
+        return xxhash64(data, size, Seed);
+    }
+
+    /***
+      * 64位整数的混合函数（splitmix64的最后一步），双射，
+      * 用于整数键，比对8字节求xxhash64快得多
+      */
+    static uint64_t mix64(uint64_t key)
+    {
+        key ^= key >> 30;
+        key *= 0xBF58476D1CE4E5B9ULL;
+        key ^= key >> 27;
+        key *= 0x94D049BB133111EBULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    /***
+      * 将哈希值均匀地映射到[0, n)，用乘法和移位代替取模
+      */
+    static uint32_t reduce(uint64_t hash, uint32_t n)
+    {
+        return static_cast<uint32_t>(((hash >> 32) * static_cast<uint64_t>(n)) >> 32);
+    }
+
+    /***
+      * Jump Consistent Hash（Lamping和Veach，2014），不需要存储，
+      * 桶数从n变成n+1时，只有约1/(n+1)的键改变所在的桶，且只会移到新增的桶，
+      * 适用于桶只在尾部增减的场景，如按编号分片的队列和表
+      * @key: 键的哈希值
+      * @return: 返回[0, num_buckets)中的一个桶，num_buckets不大于0时返回-1
+      */
+    static int32_t jump_consistent_hash(uint64_t key, int32_t num_buckets)
+    {
+        int64_t b = -1;
+        int64_t j = 0;
+
+        while (j < num_buckets)
+        {
+            b = j;
+            key = key * 2862933555777941757ULL + 1;
+            j = static_cast<int64_t>((b + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+        }
+
+        return static_cast<int32_t>(b);
+    }
+
+    /***
+      * Rendezvous哈希（最高随机权重），每个节点与键求分数，选分数最高的节点，
+      * 节点可以任意增删，删除节点时只有原属于它的键会移动，适用于节点数不多的场景
+      * @key: 键的哈希值
+      * @node_hashes: 各节点的哈希值，如节点名的xxhash64，节点的顺序不影响结果
+      * @return: 返回选中节点的下标，node_hashes为空时返回-1
+      */
+    static int rendezvous_hash(uint64_t key, const std::vector<uint64_t>& node_hashes)
+    {
+        int selected = -1;
+        uint64_t max_score = 0;
+
+        for (size_t i=0; i<node_hashes.size(); ++i)
+        {
+            const uint64_t score = mix64(key ^ node_hashes[i]);
+            if ((-1 == selected) || (score > max_score))
+            {
+                selected = static_cast<int>(i);
+                max_score = score;
+            }
+        }
+
+        return selected;
+    }
+
+    /***
+      * 带权重的Rendezvous哈希，键落在各节点的概率与其权重成正比
+      * @weights: 各节点的权重，与node_hashes一一对应，权重不大于0的节点不会被选中
+      */
+    static int weighted_rendezvous_hash(uint64_t key, const std::vector<uint64_t>& node_hashes, const std::vector<double>& weights)
+    {
+        int selected = -1;
+        double max_score = 0;
+
+        for (size_t i=0; (i<node_hashes.size()) && (i<weights.size()); ++i)
+        {
+            if (weights[i] <= 0)
+                continue;
+
+            // 取(0, 1)上的均匀分布u，分数为-weight/ln(u)
+            const double u = (static_cast<double>(mix64(key ^ node_hashes[i]) >> 11) + 0.5) / static_cast<double>(1ULL << 53);
+            const double score = -weights[i] / log(u);
+            if ((-1 == selected) || (score > max_score))
+            {
+                selected = static_cast<int>(i);
+                max_score = score;
+            }
+        }
+
+        return selected;
+    }
+
+private:
+    static const uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+    static const uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t rotl64(uint64_t x, int n)
+    {
+        return (x << n) | (x >> (64 - n));
+    }
+
+    // 按小端读取，保证不同平台结果相同
+    static uint64_t read64(const unsigned char* p)
+    {
+        uint64_t n;
+        memcpy(&n, p, sizeof(n));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        n = __builtin_bswap64(n);
+#endif
+        return n;
+    }
+
+    static uint32_t read32(const unsigned char* p)
+    {
+        uint32_t n;
+        memcpy(&n, p, sizeof(n));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        n = __builtin_bswap32(n);
+#endif
+        return n;
+    }
+
+    static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+    {
+        acc += input * prime64_2;
+        acc = rotl64(acc, 31);
+        return acc * prime64_1;
+    }
+
+    static uint64_t xxh64_merge_round(uint64_t acc, uint64_t value)
+    {
+        acc ^= xxh64_round(0, value);
+        return acc * prime64_1 + prime64_4;
+    }
+};
+
+/***
+  * 可用于hash_map/unordered_map的哈希函数对象，种子在编译期确定，
+  * 如：std::unordered_map<std::string, int, CXXHash64Hasher<> >
+  */
+template <uint64_t Seed=0>
+struct CXXHash64Hasher
+{
+    size_t operator ()(const std::string& str) const
+    {
+        return static_cast<size_t>(CHashUtils::xxhash64(str.data(), str.size(), Seed));
+    }
+
+    size_t operator ()(uint64_t key) const
+    {
+        return static_cast<size_t>(CHashUtils::mix64(key ^ Seed));
+    }
+};
+
+/***
+  * 基于虚拟节点的一致性哈希环，节点可以任意增删和设置权重，
+  * 删除节点时只有原属于它的键会移动，节点数较多时查找比rendezvous_hash快（二分查找）
+  * 非线程安全，增删节点和查找需要由调用者同步
+  *
+  * 使用示例：
+  * CConsistentHash ring;
+  * ring.add_node("10.0.0.1:6379");
+  * ring.add_node("10.0.0.2:6379");
+  * const std::string& node = ring.get_node(CHashUtils::xxhash64(key));
+  */
+class CConsistentHash
+{
+public:
+    /***
+      * @virtual_nodes: 权重为1的节点对应的虚拟节点数，越大分布越均匀，但占用内存越多
+      */
+    explicit CConsistentHash(int virtual_nodes=160)
+        : _virtual_nodes(virtual_nodes)
+    {
+    }
+
+    /***
+      * 增加一个节点，同名节点已存在时先删除
+      * @weight: 权重，虚拟节点数为virtual_nodes*weight
+      */
+    void add_node(const std::string& node, double weight=1.0)
+    {
+        remove_node(node);
+
+        const uint64_t node_hash = CHashUtils::xxhash64(node);
+        const int points = std::max(1, static_cast<int>(_virtual_nodes * weight + 0.5));
+        _nodes.push_back(node);
+        for (int i=0; i<points; ++i)
+            _ring.push_back(Point(CHashUtils::mix64(node_hash + static_cast<uint64_t>(i)), node));
+        std::sort(_ring.begin(), _ring.end());
+    }
+
+    void remove_node(const std::string& node)
+    {
+        std::vector<std::string>::iterator iter = std::find(_nodes.begin(), _nodes.end(), node);
+        if (iter == _nodes.end())
+            return;
+
+        _nodes.erase(iter);
+        size_t count = 0;
+        for (size_t i=0; i<_ring.size(); ++i)
+        {
+            if (_ring[i].node != node)
+                _ring[count++] = _ring[i];
+        }
+        _ring.erase(_ring.begin()+count, _ring.end());
+    }
+
+    /***
+      * 得到键所属的节点
+      * @key: 键的哈希值
+      * @return: 没有节点时返回空字符串
+      */
+    const std::string& get_node(uint64_t key) const
+    {
+        static const std::string empty;
+        if (_ring.empty())
+            return empty;
+
+        std::vector<Point>::const_iterator iter = std::lower_bound(_ring.begin(), _ring.end(), Point(key, empty));
+        if (iter == _ring.end())
+            iter = _ring.begin(); // 环绕
+        return iter->node;
+    }
+
+    const std::vector<std::string>& get_nodes() const { return _nodes; }
+    bool empty() const { return _nodes.empty(); }
+
+private:
+    struct Point
+    {
+        uint64_t hash;
+        std::string node;
+
+        Point(uint64_t hash_, const std::string& node_)
+            : hash(hash_), node(node_)
+        {
+        }
+
+        // 哈希相同时按节点名排序，保证结果与节点的加入顺序无关
+        bool operator <(const Point& other) const
+        {
+            return (hash < other.hash) || ((hash == other.hash) && (node < other.node));
+        }
+    };
+
+private:
+    int _virtual_nodes;
+    std::vector<std::string> _nodes;
+    std::vector<Point> _ring; // 按hash排序
+};
+
 UTILS_NAMESPACE_END
 #endif // MOOON_UTILS_HASH_UTILS_H
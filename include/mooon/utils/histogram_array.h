@@ -18,42 +18,47 @@
  */
 #ifndef MOOON_UTILS_HISTOGRAM_ARRAY_H
 #define MOOON_UTILS_HISTOGRAM_ARRAY_H
-#include "mooon/utils/config.h"
+#include "mooon/utils/small_vector.h"
+#include <algorithm>
 UTILS_NAMESPACE_BEGIN
 
 /***
-  * 直方图数组
+  * 直方图数组，可用作倒排表，每个柱为一个CSmallVector，
+  * 元素不多于InlineSize个时不分配内存，超过后容量按倍数增长
+  *
+  * Sorted为true时柱内元素保持有序（要求DataType支持<），
+  * 去重检查、查找和删除使用二分查找，否则为线性查找，元素按插入顺序存放
+  *
+  * 建好后如只读，可调用freeze转成CSR形式：所有柱的元素连续存放在一个数组中，
+  * 另用一个偏移数组记录每个柱的开始位置，不再有每个柱的对象和零散的内存块，
+  * 冻结后insert和remove总是返回false
   */
-template <typename DataType>
+template <typename DataType, bool Sorted=false, size_t InlineSize=4>
 class CHistogramArray
 {
 public:
     /** 数组存储的元素类型 */
     typedef DataType _DataType;
-    
+    typedef CSmallVector<DataType, InlineSize> Histogram;
+
     /***
       * 构造一个直方图数组
       * @array_size: 直方图数组大小
       */
     CHistogramArray(uint32_t array_size)
         :_array_size(array_size)
+        ,_frozen_offsets(NULL)
+        ,_frozen_elems(NULL)
     {
-        _histogram_size_array = new uint32_t[array_size];
-        _elem_array = new DataType*[array_size];
-
-        for (uint32_t i=0; i<array_size; ++i)
-        {
-            _elem_array[i] = NULL;
-            _histogram_size_array[i] = 0; // 初始化每个柱大小为0
-        }
+        _histogram_array = new Histogram[array_size];
     }
 
     /** 析构直方图数组 */
     ~CHistogramArray()
     {
-        for (uint32_t i=0; i<_array_size; ++i)
-            delete []_elem_array[i];
-        delete [](DataType**)_elem_array;
+        delete []_histogram_array;
+        delete []_frozen_offsets;
+        delete []_frozen_elems;
     }
 
     /***
@@ -65,35 +70,11 @@ public:
       */
     bool insert(uint32_t position, DataType elem, bool unique=true)
     {
-        if (!histogram_exist(position))
-        {
-            _elem_array[position] = new DataType[1];
-            _elem_array[position][0] = elem;
+        if (is_frozen() || (position >= _array_size))
+            return false;
 
-            ++_histogram_size_array[position];
-            return true;
-        }
-        else
-        {                    
-            uint32_t histogram_size = get_histogram_size(position);
-            if (unique)
-            {
-                for (uint32_t i=0; i<histogram_size; ++i)
-                    if (_elem_array[position][i] == elem)
-                        return false;
-            }
-
-            DataType* elem_array = new DataType[histogram_size+1];
-            memcpy(&elem_array[0], _elem_array[position], histogram_size);
-        
-            delete []_elem_array[position];
-            _elem_array[position] = elem_array;
-
-            _elem_array[position][histogram_size] = elem;
-            ++_histogram_size_array[position];
-        
-            return true;
-        }
+        Histogram& histogram = _histogram_array[position];
+        return insert(histogram, elem, unique, static_cast<SortedTag*>(NULL));
     }
 
     /***
@@ -105,31 +86,68 @@ public:
     bool remove(uint32_t position, DataType elem)
     {
         /** 直方图不存在 */
-        DataType* histogram = get_histogram(position);
-        if (NULL == histogram) return false;
+        if (is_frozen() || !histogram_exist(position)) return false;
 
-        uint32_t histogram_size = get_histogram_size(position);
-        for (uint32_t i=0; i<histogram_size; ++i)
+        Histogram& histogram = _histogram_array[position];
+        const DataType* found = find(histogram.data(), histogram.data()+histogram.size(), elem, static_cast<SortedTag*>(NULL));
+        if (NULL == found)
+            return false;
+
+        histogram.erase(histogram.begin() + (found - histogram.data()));
+        return true;
+    }
+
+    /** 判断元素是否在直方图中 */
+    bool exist(uint32_t position, DataType elem) const
+    {
+        const DataType* histogram = get_histogram(position);
+        if (NULL == histogram)
+            return false;
+        return find(histogram, histogram+get_histogram_size(position), elem, static_cast<SortedTag*>(NULL)) != NULL;
+    }
+
+    /***
+      * 转成只读的CSR形式，释放每个柱各自的存储
+      * 冻结后get_histogram返回的指针一直有效
+      */
+    void freeze()
+    {
+        if (is_frozen())
+            return;
+
+        size_t total = 0;
+        _frozen_offsets = new size_t[_array_size + 1];
+        for (uint32_t i=0; i<_array_size; ++i)
         {
-            if (_elem_array[position][i] == elem)
-            {
-                DataType* elem_array = NULL;
-                if (histogram_size > 1)
-                {
-                    elem_array = new DataType[histogram_size-1];
-                    memcpy(&elem_array[0], &_elem_array[position][0], i);
-                    memcpy(&elem_array[i], &_elem_array[position][i+1], histogram_size-i-1);
-                }                                              
-
-                delete []_elem_array[position];
-                _elem_array[position] = elem_array;
-                --_histogram_size_array[position];
-
-                return true;
-            }
+            _frozen_offsets[i] = total;
+            total += _histogram_array[i].size();
         }
+        _frozen_offsets[_array_size] = total;
 
-        return false;
+        _frozen_elems = new DataType[(total > 0)? total: 1];
+        for (uint32_t i=0; i<_array_size; ++i)
+            std::copy(_histogram_array[i].begin(), _histogram_array[i].end(), _frozen_elems+_frozen_offsets[i]);
+
+        delete []_histogram_array;
+        _histogram_array = NULL;
+    }
+
+    /** 是否已冻结 */
+    bool is_frozen() const
+    {
+        return _frozen_offsets != NULL;
+    }
+
+    /** 得到所有直方图的元素总个数 */
+    size_t get_elem_number() const
+    {
+        if (is_frozen())
+            return _frozen_offsets[_array_size];
+
+        size_t total = 0;
+        for (uint32_t i=0; i<_array_size; ++i)
+            total += _histogram_array[i].size();
+        return total;
     }
 
     /** 得到可容纳的直方图个数 */
@@ -140,26 +158,80 @@ public:
 
     /** 检测一个直方图是否存在 */
     bool histogram_exist(uint32_t position) const
-    {        
-        return get_histogram(position) != NULL;
+    {
+        return get_histogram_size(position) > 0;
     }
 
     /** 得到直方图大小 */
     uint32_t get_histogram_size(uint32_t position) const
     {
-        return (position < get_capacity())? _histogram_size_array[position]: 0;
+        if (position >= get_capacity())
+            return 0;
+        if (is_frozen())
+            return static_cast<uint32_t>(_frozen_offsets[position+1] - _frozen_offsets[position]);
+        return static_cast<uint32_t>(_histogram_array[position].size());
     }
 
-    /** 得到直方图 */
+    /***
+      * 得到直方图，直方图为空时返回NULL，
+      * 未冻结时插入和删除后之前得到的指针失效
+      */
     DataType* get_histogram(uint32_t position) const
     {
-        return (position < get_capacity())? _elem_array[position]: NULL;
+        if (!histogram_exist(position))
+            return NULL;
+        if (is_frozen())
+            return _frozen_elems + _frozen_offsets[position];
+        return const_cast<DataType*>(_histogram_array[position].data());
+    }
+
+private:
+    template <bool> struct Tag {};
+    typedef Tag<Sorted> SortedTag;
+
+    // 有序时二分查找插入位置，插入后仍有序
+    static bool insert(Histogram& histogram, const DataType& elem, bool unique, Tag<true>*)
+    {
+        typename Histogram::iterator iter = std::lower_bound(histogram.begin(), histogram.end(), elem);
+        if (unique && (iter != histogram.end()) && !(elem < *iter))
+            return false;
+
+        histogram.insert(iter, elem);
+        return true;
+    }
+
+    static bool insert(Histogram& histogram, const DataType& elem, bool unique, Tag<false>*)
+    {
+        if (unique && (find(histogram.data(), histogram.data()+histogram.size(), elem, static_cast<Tag<false>*>(NULL)) != NULL))
+            return false;
+
+        histogram.push_back(elem);
+        return true;
+    }
+
+    static const DataType* find(const DataType* first, const DataType* last, const DataType& elem, Tag<true>*)
+    {
+        const DataType* iter = std::lower_bound(first, last, elem);
+        return ((iter != last) && !(elem < *iter))? iter: NULL;
     }
-    
+
+    static const DataType* find(const DataType* first, const DataType* last, const DataType& elem, Tag<false>*)
+    {
+        for (const DataType* iter=first; iter!=last; ++iter)
+            if (*iter == elem)
+                return iter;
+        return NULL;
+    }
+
+private:
+    CHistogramArray(const CHistogramArray&);
+    CHistogramArray& operator =(const CHistogramArray&);
+
 private:
-    uint32_t _array_size;            /** 直方图数组大小 */
-    DataType** _elem_array;          /** 直方图元素数组 */
-    uint32_t* _histogram_size_array; /** 直方图大小数组 */
+    uint32_t _array_size;          /** 直方图数组大小 */
+    Histogram* _histogram_array;   /** 直方图数组，冻结后为NULL */
+    size_t* _frozen_offsets;       /** 冻结后每个柱在_frozen_elems中的开始位置，共_array_size+1个 */
+    DataType* _frozen_elems;       /** 冻结后所有柱的元素 */
 };
 
 UTILS_NAMESPACE_END
@@ -20,8 +20,19 @@
 #define MOOON_UTILS_INTEGER_UTILS_H
 #include "mooon/utils/config.h"
 #include <math.h>
+#include <vector>
 UTILS_NAMESPACE_BEGIN
 
+/***
+  * 整数数组的压缩方式，见CIntegerUtils::compress
+  */
+typedef enum
+{
+    integer_codec_varint = 0, /** 逐个变长编码，适合值大多较小的 */
+    integer_codec_for    = 1, /** 每128个一块，减去块内最小值后按最大位数打包（frame of reference），适合值域集中的 */
+    integer_codec_delta  = 2  /** 先求相邻差再按块打包，适合有序的，如ID列表 */
+}integer_codec_t;
+
 /***
   * 整数数字操作工具类
   */
@@ -75,6 +86,82 @@ public:
     /** 判断一个数字是否可为uint32_t数字 */
     static bool is_uint32(int64_t num);
     static bool is_uint32(uint64_t num);
+
+public:
+    /***
+      * zigzag编码，将有符号数映射为无符号数，绝对值小的映射为小的数，
+      * 负数再以varint编码时不会总是占满字节：0->0, -1->1, 1->2, -2->3
+      */
+    static uint32_t zigzag_encode(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+    static int32_t zigzag_decode(uint32_t value) { return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1)); }
+    static uint64_t zigzag_encode(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+    static int64_t zigzag_decode(uint64_t value) { return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1)); }
+
+    /** varint（LEB128，和protobuf相同）编码后的字节数 */
+    static size_t get_varint_size(uint64_t value);
+
+    /***
+      * varint编码，每字节7位，最高位为1表示后面还有字节
+      * @buffer: 大小不能小于get_varint_size(value)，uint64_t最多10字节
+      * @return: 写入的字节数
+      */
+    static size_t encode_varint(uint64_t value, char* buffer);
+
+    /***
+      * varint解码
+      * @return: 读取的字节数，数据不完整或超过10字节时返回0
+      */
+    static size_t decode_varint(const char* buffer, size_t size, uint64_t* value);
+    static size_t decode_varint(const char* buffer, size_t size, uint32_t* value);
+
+    /***
+      * 就地求相邻差：values[i] -= values[i-1]，values[0] -= base，
+      * 无序时差按无符号数回绕，delta_decode仍能还原
+      */
+    static void delta_encode(uint32_t* values, size_t n, uint32_t base=0);
+    static void delta_encode(uint64_t* values, size_t n, uint64_t base=0);
+
+    /** 就地求前缀和，还原delta_encode */
+    static void delta_decode(uint32_t* values, size_t n, uint32_t base=0);
+    static void delta_decode(uint64_t* values, size_t n, uint64_t base=0);
+
+    /** 表示values中所有值需要的最多位数 */
+    static uint32_t get_max_bits(const uint32_t* values, size_t n);
+    static uint32_t get_max_bits(const uint64_t* values, size_t n);
+
+    /***
+      * 将128个值按每个bits位打包，共bits*16字节，
+      * 按4路竖排（第i个值在第i%4路），以SSE2每次处理4个值，非x86平台为逐个的标量实现，结果相同
+      * @values: 每个值须已不超过bits位
+      * @bits: 0到32
+      */
+    static void pack128(const uint32_t* values, uint32_t bits, char* buffer);
+
+    /** 解开pack128打包的128个值 */
+    static void unpack128(const char* buffer, uint32_t bits, uint32_t* values);
+
+    /** 64位的打包，每个bits位（0到64）依次排列，共bits*16字节 */
+    static void pack128(const uint64_t* values, uint32_t bits, char* buffer);
+    static void unpack128(const char* buffer, uint32_t bits, uint64_t* values);
+
+    /** compress压缩n个值最多需要的字节数 */
+    static size_t get_max_compressed_size(size_t n, size_t value_size=sizeof(uint64_t));
+
+    /***
+      * 压缩整数数组，压缩后的数据自带方式和个数，用于网络传输和持久化，
+      * 块内打包前减去块内最小值，因此值域集中时也能压缩
+      * @buffer: 大小不能小于get_max_compressed_size(n, sizeof(T))
+      * @return: 压缩后的字节数
+      */
+    static size_t compress(const uint32_t* values, size_t n, char* buffer, integer_codec_t codec);
+    static size_t compress(const uint64_t* values, size_t n, char* buffer, integer_codec_t codec);
+
+    /***
+      * 解压compress压缩的数据，追加到values中
+      * @return: 读取的字节数，数据不完整或格式不对时返回0，values不变
+      */
+    static size_t decompress(const char* buffer, size_t size, std::vector<uint32_t>* values);
+    static size_t decompress(const char* buffer, size_t size, std::vector<uint64_t>* values);
 };
 
 UTILS_NAMESPACE_END
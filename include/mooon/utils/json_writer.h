@@ -0,0 +1,270 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_JSON_WRITER_H
+#define MOOON_UTILS_JSON_WRITER_H
+#include "mooon/utils/config.h"
+#include <map>
+#include <string>
+#include <vector>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * CJsonWriter的输出目标，数据先攒在写者的缓冲区中，满了或flush时才交给sink
+  */
+class CJsonSink
+{
+public:
+    virtual ~CJsonSink() {}
+    virtual void append(const char* data, size_t size) = 0;
+};
+
+/** 追加到std::string */
+class CStringJsonSink: public CJsonSink
+{
+public:
+    CStringJsonSink(std::string* str)
+        : _str(str)
+    {
+    }
+
+    virtual void append(const char* data, size_t size)
+    {
+        _str->append(data, size);
+    }
+
+private:
+    std::string* _str;
+};
+
+/***
+  * 追加到链式缓冲区（如net::CIoBuffer，须有append(const char*, size_t)），
+  * 大的响应不必先拼成一个连续的字符串
+  */
+template <class IoBuffer>
+class CIoBufferJsonSink: public CJsonSink
+{
+public:
+    CIoBufferJsonSink(IoBuffer* io_buffer)
+        : _io_buffer(io_buffer)
+    {
+    }
+
+    virtual void append(const char* data, size_t size)
+    {
+        _io_buffer->append(data, size);
+    }
+
+private:
+    IoBuffer* _io_buffer;
+};
+
+/***
+  * 流式JSON写者，直接向缓冲区追加，不构造中间的DOM或临时字符串：
+  * 字符串以向量指令找出须转义的字节（CStringSimd::find_json_escape），不须转义的连续字节整段复制，
+  * 整数以两位一组的查表法转换，浮点数以最短的可精确还原的形式输出（C++17的to_chars，否则为%.17g）。
+  *
+  * 逗号和冒号由写者自动添加，调用者只需按顺序调用，对象中每个值之前须先调用key，
+  * 不检查调用顺序是否合法（如对象中缺少key），由调用者保证。
+  * 非线程安全。
+  *
+  * 使用示例：
+  * std::string json;
+  * mooon::utils::CJsonWriter writer(&json);
+  * writer.begin_object();
+  * writer.key("name").value("mooon");
+  * writer.key("ports").begin_array().value(2015).value(2016).end_array();
+  * writer.end_object();
+  * writer.flush(); // 或析构时自动flush
+  */
+class CJsonWriter
+{
+public:
+    /** 输出追加到str */
+    CJsonWriter(std::string* str);
+
+    /** 输出交给sink，sink的生命周期须长于写者 */
+    CJsonWriter(CJsonSink* sink);
+
+    ~CJsonWriter();
+
+    CJsonWriter& begin_object();
+    CJsonWriter& end_object();
+    CJsonWriter& begin_array();
+    CJsonWriter& end_array();
+
+    /** 对象成员的名字 */
+    CJsonWriter& key(const char* str, size_t size);
+    CJsonWriter& key(const char* str);
+    CJsonWriter& key(const std::string& str) { return key(str.data(), str.size()); }
+
+    CJsonWriter& value(const char* str, size_t size);
+    CJsonWriter& value(const char* str);
+    CJsonWriter& value(const std::string& str) { return value(str.data(), str.size()); }
+    CJsonWriter& value(bool b);
+    CJsonWriter& value(int32_t n) { return value(static_cast<int64_t>(n)); }
+    CJsonWriter& value(uint32_t n) { return value(static_cast<uint64_t>(n)); }
+    CJsonWriter& value(long long n) { return value(static_cast<int64_t>(n)); }
+    CJsonWriter& value(unsigned long long n) { return value(static_cast<uint64_t>(n)); }
+    CJsonWriter& value(int64_t n);
+    CJsonWriter& value(uint64_t n);
+
+    /** NaN和无穷大在JSON中没有表示，输出为null */
+    CJsonWriter& value(double d);
+
+    CJsonWriter& null_value();
+
+    /** 原样输出一段已经是合法JSON的数据（如缓存的子对象） */
+    CJsonWriter& raw_value(const char* json, size_t size);
+
+    /** 将缓冲区中的数据交给sink */
+    void flush();
+
+    /** 嵌套的层数，为0时表示一个完整的值已经写完 */
+    size_t get_depth() const { return _first.size(); }
+
+public:
+    /***
+      * 将[str, str+size)按JSON的规则转义后追加到out（不含两边的引号），
+      * 转义"、\和小于0x20的控制字符，其它字节（包括UTF-8的多字节字符）原样输出
+      */
+    static void escape(const char* str, size_t size, std::string* out);
+
+    /***
+      * 将整数转成十进制字符串，写入buffer，不添加结尾符
+      * @buffer: 大小不能小于20（负数为21）
+      * @return: 写入的字节数
+      */
+    static size_t format_integer(uint64_t n, char* buffer);
+    static size_t format_integer(int64_t n, char* buffer);
+
+private:
+    CJsonWriter(const CJsonWriter&);
+    CJsonWriter& operator =(const CJsonWriter&);
+
+    void prefix();
+    void write_string(const char* str, size_t size);
+    void reserve(size_t size);
+
+    void put(char c)
+    {
+        reserve(1);
+        _buffer[_size++] = c;
+    }
+
+    void put(const char* data, size_t size);
+
+private:
+    CStringJsonSink _string_sink;
+    CJsonSink* _sink;
+    char _buffer[4096];
+    size_t _size;
+    std::vector<bool> _first; // 各层是否还没有成员
+    bool _after_key;
+};
+
+/** 以CJsonWriter::value输出一个值，重载以支持更多的类型 */
+template <typename T>
+inline void json_value(CJsonWriter* writer, const T& value)
+{
+    writer->value(value);
+}
+
+template <typename T>
+inline void json_value(CJsonWriter* writer, const std::vector<T>& container)
+{
+    writer->begin_array();
+    for (typename std::vector<T>::const_iterator iter=container.begin(); iter!=container.end(); ++iter)
+        json_value(writer, *iter);
+    writer->end_array();
+}
+
+template <typename T>
+inline void json_value(CJsonWriter* writer, const std::map<std::string, T>& map)
+{
+    writer->begin_object();
+    for (typename std::map<std::string, T>::const_iterator iter=map.begin(); iter!=map.end(); ++iter)
+    {
+        writer->key(iter->first);
+        json_value(writer, iter->second);
+    }
+    writer->end_object();
+}
+
+/***
+  * 将容器（vector、list、set等）转成JSON数组，对应CStringUtils::container2string，
+  * 元素为可被json_value输出的类型
+  */
+template <class ContainerClass>
+inline std::string container2json(const ContainerClass& container)
+{
+    std::string str;
+    {
+        CJsonWriter writer(&str);
+        writer.begin_array();
+        for (typename ContainerClass::const_iterator iter=container.begin(); iter!=container.end(); ++iter)
+            json_value(&writer, *iter);
+        writer.end_array();
+    }
+    return str;
+}
+
+/** map的键转成JSON对象的键 */
+inline const std::string& json_key(const std::string& key)
+{
+    return key;
+}
+
+inline std::string json_key(int64_t key)
+{
+    char buffer[24];
+    return std::string(buffer, CJsonWriter::format_integer(key, buffer));
+}
+
+inline std::string json_key(uint64_t key)
+{
+    char buffer[24];
+    return std::string(buffer, CJsonWriter::format_integer(key, buffer));
+}
+
+inline std::string json_key(int32_t key) { return json_key(static_cast<int64_t>(key)); }
+inline std::string json_key(uint32_t key) { return json_key(static_cast<uint64_t>(key)); }
+
+/***
+  * 将map转成JSON对象，对应CStringUtils::map2string，键为std::string或整数，值为可被json_value输出的类型，
+  * 整数的键被转成字符串（JSON的键只能是字符串）
+  */
+template <class MapClass>
+inline std::string map2json(const MapClass& map)
+{
+    std::string str;
+    {
+        CJsonWriter writer(&str);
+        writer.begin_object();
+        for (typename MapClass::const_iterator iter=map.begin(); iter!=map.end(); ++iter)
+        {
+            writer.key(json_key(iter->first));
+            json_value(&writer, iter->second);
+        }
+        writer.end_object();
+    }
+    return str;
+}
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_JSON_WRITER_H
@@ -50,6 +50,12 @@ public:
     /** 关联前一个可链表对象 */
     void set_prev(ListableClass* prev) { _prev = prev; }
 
+    /** 以acquire语义得到下一个可链表对象，用于无锁队列（如CMpscListQueue） */
+    ListableClass* load_next() const { return __atomic_load_n(&_next, __ATOMIC_ACQUIRE); }
+
+    /** 以release语义关联下一个可链表对象，用于无锁队列（如CMpscListQueue） */
+    void store_next(ListableClass* next) { __atomic_store_n(&_next, next, __ATOMIC_RELEASE); }
+
 private:
     ListableClass* _next;
     ListableClass* _prev;
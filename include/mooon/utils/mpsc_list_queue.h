@@ -0,0 +1,198 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_MPSC_LIST_QUEUE_H
+#define MOOON_UTILS_MPSC_LIST_QUEUE_H
+#include "mooon/utils/listable.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 多生产者单消费者（MPSC）无锁侵入式队列（Vyukov算法），
+  * 复用CListable中的_next作为链接，入队不分配内存、不加锁，
+  * 适合将对象（如连接、任务）从多个线程交给一个消费者线程（如事件循环线程或日志线程）。
+  *
+  * 1) push可被任意多个线程同时调用，只有一次原子交换，不会失败，也不会等待
+  * 2) pop和pop_batch只能被一个线程调用（消费者）
+  * 3) 一个对象同时只能在一个队列中，出队后才能再次入队，队列不负责对象的销毁
+  * 4) 生产者在原子交换之后、链接之前被切换走时，消费者暂时看不到它及之后入队的对象，
+  *    这时pop返回NULL，但is_empty为false，消费者应稍后重试（如在下次被唤醒时）
+  *
+  * push返回入队前队列是否为空，生产者据此决定是否需要唤醒消费者（如写eventfd），
+  * 这样一批连续的push只需一次唤醒。相应地，消费者被唤醒后应一直取到is_empty为true，
+  * 只有pop返回NULL但is_empty为false时（见4），不能进入等待，而应让出CPU后重试。
+  *
+  * 使用示例：
+  * class CTask: public mooon::utils::CListable<CTask> {};
+  * mooon::utils::CMpscListQueue<CTask> queue;
+  * if (queue.push(task)) wakeup_consumer(); // 生产者
+  * while ((task = queue.pop()) != NULL) run(task); // 消费者
+  */
+template <class ListableClass>
+class CMpscListQueue
+{
+public:
+    CMpscListQueue()
+        :_head(NULL)
+        ,_number(0)
+        ,_tail(NULL)
+    {
+        _stub = new ListableClass;
+        _head = _stub;
+        _tail = _stub;
+    }
+
+    ~CMpscListQueue()
+    {
+        delete _stub;
+    }
+
+    /** 得到队列中元素个数，是近似值，可能包含正在入队的 */
+    int get_number() const
+    {
+        return __atomic_load_n(&_number, __ATOMIC_RELAXED);
+    }
+
+    /** 判断队列是否为空 */
+    bool is_empty() const
+    {
+        return 0 == get_number();
+    }
+
+    /***
+      * 在队尾添加一个可链表对象，可被多个线程同时调用
+      * @return: 如果入队前队列为空则返回true，这时需要唤醒消费者
+      */
+    bool push(ListableClass* listable)
+    {
+        return push(listable, listable, 1);
+    }
+
+    /***
+      * 添加一串已由set_next链接好的对象，只需一次原子交换，可被多个线程同时调用
+      * @first: 第一个对象
+      * @last: 最后一个对象，它的next被置为NULL
+      * @number: 对象个数
+      * @return: 如果入队前队列为空则返回true，这时需要唤醒消费者
+      */
+    bool push(ListableClass* first, ListableClass* last, int number)
+    {
+        MOOON_ASSERT((first != NULL) && (last != NULL) && (number > 0));
+        last->set_next(NULL);
+        const bool was_empty = (0 == __atomic_fetch_add(&_number, number, __ATOMIC_ACQ_REL));
+
+        // 交换之后、链接之前，链在prev处断开，消费者到此为止
+        ListableClass* prev = __atomic_exchange_n(&_head, last, __ATOMIC_ACQ_REL);
+        prev->store_next(first);
+        return was_empty;
+    }
+
+    /***
+      * 从队首取出一个对象，只能被消费者线程调用
+      * @return: 队首对象，如果队列为空或生产者正在链接，则返回NULL
+      */
+    ListableClass* pop()
+    {
+        ListableClass* listable = pop_one();
+        if (listable != NULL)
+            __atomic_fetch_sub(&_number, 1, __ATOMIC_RELAXED);
+        return listable;
+    }
+
+    /***
+      * 一次取出多个对象，只能被消费者线程调用，元素个数只更新一次
+      * @listable_array: 存储取出的对象
+      * @array_size: listable_array的大小
+      * @return: 实际取出的个数
+      */
+    int pop_batch(ListableClass** listable_array, int array_size)
+    {
+        int number = 0;
+        for (ListableClass* listable; number < array_size; ++number)
+        {
+            listable = pop_one();
+            if (NULL == listable)
+                break;
+            listable_array[number] = listable;
+        }
+
+        if (number > 0)
+            __atomic_fetch_sub(&_number, number, __ATOMIC_RELAXED);
+        return number;
+    }
+
+private:
+    CMpscListQueue(const CMpscListQueue&);
+    CMpscListQueue& operator =(const CMpscListQueue&);
+
+    ListableClass* pop_one()
+    {
+        ListableClass* tail = _tail;
+        ListableClass* next = tail->load_next();
+
+        // 跳过哑结点
+        if (tail == _stub)
+        {
+            if (NULL == next)
+                return NULL;
+            _tail = next;
+            tail = next;
+            next = next->load_next();
+        }
+        if (next != NULL)
+        {
+            _tail = next;
+            return take(tail);
+        }
+
+        // tail不是最后一个说明有生产者正在链接，否则将哑结点放回，让tail可以出队
+        if (tail != __atomic_load_n(&_head, __ATOMIC_ACQUIRE))
+            return NULL;
+        push_stub();
+        next = tail->load_next();
+        if (NULL == next)
+            return NULL;
+
+        _tail = next;
+        return take(tail);
+    }
+
+    static ListableClass* take(ListableClass* listable)
+    {
+        listable->set_next(NULL);
+        return listable;
+    }
+
+    // 哑结点入队不计数
+    void push_stub()
+    {
+        _stub->set_next(NULL);
+        ListableClass* prev = __atomic_exchange_n(&_head, _stub, __ATOMIC_ACQ_REL);
+        prev->store_next(_stub);
+    }
+
+private:
+    char _pad0[CACHE_LINE_SIZE];
+    ListableClass* _head; /** 最后入队的对象，被生产者原子交换 */
+    int _number;          /** 元素个数，被生产者和消费者原子修改 */
+    char _pad1[CACHE_LINE_SIZE];
+    ListableClass* _tail; /** 下一个出队的对象，只被消费者修改 */
+    ListableClass* _stub; /** 哑结点，保证链表总不为空 */
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_MPSC_LIST_QUEUE_H
@@ -23,8 +23,14 @@
 #include <regex.h>
 #include <string.h>
 #include <sys/types.h>
+#include <string>
+#include <utility>
+#include <vector>
 UTILS_NAMESPACE_BEGIN
 
+/** 一个分组匹配的起止偏移[first, second)，未参与匹配的分组为(-1, -1) */
+typedef std::pair<int, int> regex_capture_t;
+
 class CRegexHelper
 {
 public:
@@ -32,40 +38,159 @@ public:
     // 出错抛异常CException
     CRegexHelper(const char* pattern, int cflags=REG_EXTENDED);
     ~CRegexHelper();
-    std::string get_error_message(int errcode);
+    std::string get_error_message(int errcode) const;
 
     // eflags可选值：REG_NOTBOL, REG_NOTEOL，两种可按位组合
-    bool match(const char* str, int eflags=REG_NOTBOL);
+    bool match(const char* str, int eflags=REG_NOTBOL) const;
+
+    /***
+      * 匹配data开始的size个字节（可以不以结尾符结束，以REG_STARTEND实现），
+      * 匹配时captures依次为整个匹配和各分组的偏移，编译时带REG_NOSUB的为空，captures可为NULL
+      */
+    bool match(const char* data, size_t size, std::vector<regex_capture_t>* captures, int eflags=0) const;
+
+    const std::string& get_pattern() const { return _pattern; }
+    int get_cflags() const { return _cflags; }
+
+    /** 分组个数，不包括整个匹配 */
+    size_t get_group_number() const { return _regex.re_nsub; }
+
+    /***
+      * 从全局缓存中取得已编译的正则表达式，没有时编译后加入缓存，线程安全，
+      * 用于避免在循环中反复regcomp同一个模式（如按配置的模式过滤），
+      * 缓存不淘汰，返回的对象在进程退出前有效，不能delete，只应用于个数有限的模式。
+      * 注意glibc的regexec对同一个regex_t加锁，多个线程密集地使用同一个模式时应各自编译。
+      * @exception: 模式出错时抛出CException异常
+      */
+    static const CRegexHelper* get_cached(const std::string& pattern, int cflags=REG_EXTENDED);
+
+private:
+    CRegexHelper(const CRegexHelper&);
+    CRegexHelper& operator =(const CRegexHelper&);
 
 private:
+    const std::string _pattern;
+    const int _cflags;
     regex_t _regex;
 };
 
-CRegexHelper::CRegexHelper(const char* pattern, int cflags)
+/***
+  * 正则表达式的实现，pcre2须在编译时找到库（MOOON_HAVE_PCRE2），
+  * 并以JIT编译（系统不支持JIT时退回解释执行），语法为Perl兼容的，cflags中的REG_ICASE和REG_NEWLINE仍然有效
+  */
+typedef enum
 {
-    int errcode = regcomp(&_regex, pattern, cflags);
-	if (errcode != 0)
-		THROW_EXCEPTION(get_error_message(errcode), errcode);
-}
+    regex_posix = 0, /** regcomp/regexec，REG_EXTENDED时为ERE，否则为BRE */
+    regex_pcre2 = 1  /** PCRE2（JIT） */
+}regex_backend_t;
 
-CRegexHelper::~CRegexHelper()
-{
-    regfree(&_regex);
-}
+/** 是否支持该实现，pcre2取决于编译时是否找到了库 */
+extern bool is_regex_backend_supported(regex_backend_t backend);
 
-bool CRegexHelper::match(const char* str, int eflags)
+/** CRegexSet的一个匹配结果 */
+struct regex_match_t
 {
-    regmatch_t match[1];
-    int errcode = regexec(&_regex, str, 1, match, eflags);
-    return (0 == errcode);
-}
+    int id; // add返回的规则编号
+    std::vector<regex_capture_t> captures; // 同CRegexHelper::match
+};
 
-std::string CRegexHelper::get_error_message(int errcode)
+/***
+  * 多模式匹配：一次扫描输入，得到所有匹配的规则，用于日志分类、按规则过滤等规则很多的场合。
+  *
+  * compile时从每个规则中提取任何匹配都必须包含的最长字面量（如“disk (full|error) on [a-z]+”中的“disk ”），
+  * 所有规则的字面量构造为一个Aho-Corasick自动机（ASCII不区分大小写），
+  * 匹配时先以自动机扫描一次输入，只有字面量出现了的规则才执行正则匹配，
+  * 提取不到字面量的规则（如顶层有“|”或BRE）每次都执行，可用get_literal检查。
+  * 多数规则都不匹配的输入只需扫描一次，而不是逐个执行每个规则。
+  *
+  * 编译后match是只读的，可多线程同时调用，但glibc的regexec对同一个规则加锁，
+  * 高并发时每个线程应使用各自的CRegexSet（或使用regex_pcre2）。
+  *
+  * 使用示例（日志分类，第一个匹配的规则决定分类）：
+  * mooon::utils::CRegexSet rules;
+  * rules.add("connect to [0-9.]+ timeout"); // 0
+  * rules.add("disk (full|error)", REG_EXTENDED|REG_ICASE); // 1
+  * rules.compile();
+  * const int id = rules.match_first(line.data(), line.size());
+  */
+class CRegexSet
 {
-    char errbuf[1024];
-    regerror(errcode, &_regex, errbuf, sizeof(errbuf)-1);
-    return errbuf;
-}
+public:
+    /***
+      * @exception: 不支持的实现时抛出CException异常
+      */
+    CRegexSet(regex_backend_t backend=regex_posix);
+    ~CRegexSet();
+
+    regex_backend_t get_backend() const { return _backend; }
+
+    /***
+      * 增加一个规则，之后须重新compile
+      * @cflags: 同CRegexHelper，regex_pcre2时只有REG_ICASE、REG_NEWLINE和REG_NOSUB有效
+      * @return: 规则的编号，从0开始依次递增
+      * @exception: 模式出错时抛出CException异常
+      */
+    int add(const std::string& pattern, int cflags=REG_EXTENDED);
+
+    /** 构造预筛选的自动机，add之后、match之前调用 */
+    void compile();
+
+    /***
+      * 匹配data开始的size个字节，ids为匹配的规则编号，从小到大
+      * @return: 匹配的规则个数
+      * @exception: 未compile时抛出CException异常
+      */
+    int match(const char* data, size_t size, std::vector<int>* ids, int eflags=0) const;
+    int match(const std::string& str, std::vector<int>* ids, int eflags=0) const { return match(str.data(), str.size(), ids, eflags); }
+
+    /** 同上，并带各分组的偏移，带REG_NOSUB的规则captures为空 */
+    int match(const char* data, size_t size, std::vector<regex_match_t>* matches, int eflags=0) const;
+    int match(const std::string& str, std::vector<regex_match_t>* matches, int eflags=0) const { return match(str.data(), str.size(), matches, eflags); }
+
+    /***
+      * 编号最小的匹配规则，找到后不再执行其它规则
+      * @captures: 不为NULL时为该规则的各分组偏移
+      * @return: 规则编号，都不匹配时返回-1
+      */
+    int match_first(const char* data, size_t size, std::vector<regex_capture_t>* captures=NULL, int eflags=0) const;
+
+    size_t get_pattern_number() const { return _rules.size(); }
+    const std::string& get_pattern(int id) const;
+
+    /** 规则的预筛选字面量（小写），为空时该规则每次都须执行 */
+    const std::string& get_literal(int id) const;
+
+    /***
+      * 提取模式中任何匹配都必须包含的最长字面量，提取不到时返回空字符串，
+      * 只认识ERE和PCRE的常用语法，不认识的都保守地当作非字面量
+      */
+    static std::string extract_literal(const std::string& pattern, int cflags, regex_backend_t backend);
+
+public:
+    struct Rule;
+
+private:
+    CRegexSet(const CRegexSet&);
+    CRegexSet& operator =(const CRegexSet&);
+
+    // 以自动机找出字面量出现了的规则，加上没有字面量的，从小到大放到candidates中
+    void prefilter(const char* data, size_t size, std::vector<int>* candidates) const;
+
+private:
+    const regex_backend_t _backend;
+    std::vector<Rule*> _rules;
+    std::vector<int> _always; // 没有字面量的规则
+    bool _compiled;
+    size_t _max_group_number;
+
+    // Aho-Corasick自动机，状态s输入字节类c后为_delta[s*_class_number+c]，
+    // 状态s命中的规则为_outputs[_output_offsets[s], _output_offsets[s+1])
+    unsigned char _classes[256];
+    uint32_t _class_number;
+    std::vector<uint32_t> _delta;
+    std::vector<uint32_t> _output_offsets;
+    std::vector<int> _outputs;
+};
 
 UTILS_NAMESPACE_END
 #endif // MOOON_UTILS_REGEX_HELPER_H
@@ -0,0 +1,358 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_RING_QUEUE_H
+#define MOOON_UTILS_RING_QUEUE_H
+#include "mooon/utils/config.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 无锁环形队列，和CArrayQueue接口相同，因此可直接作为CEventQueue和CEpollableQueue的RawQueueClass，
+  * 两者的区别在于：
+  * 1) 容量总是向上取整为2的幂，下标计算使用位与代替取模
+  * 2) 头尾下标分别独占一个缓存行，避免生产者和消费者间的伪共享
+  * 3) 提供try_push和try_pop，可不加锁直接在多线程间使用
+  *
+  * 基于GCC的__atomic内置函数实现，要求GCC 4.7或以上版本，不依赖C++11。
+  */
+
+/** 将n向上取整为2的幂，最小值为2 */
+inline uint32_t round_up_power_of_two(uint32_t n)
+{
+    uint32_t m = 2;
+    while (m < n)
+        m <<= 1;
+    return m;
+}
+
+/***
+  * 单生产者单消费者（SPSC）无锁环形队列
+  * 只允许一个线程push，同时只允许一个线程pop，两者可为不同线程
+  */
+template <typename DataType>
+class CSpscRingQueue
+{
+public:
+    /** 队列中的元素数据类型 */
+    typedef DataType _DataType;
+
+    /***
+      * 构造一个SPSC环形队列
+      * @queue_max: 队列大小，实际容量为不小于queue_max的2的幂
+      */
+    CSpscRingQueue(uint32_t queue_max)
+        :_head(0)
+        ,_tail(0)
+    {
+        _queue_max = round_up_power_of_two(queue_max);
+        _mask = _queue_max - 1;
+        _elem_array = new DataType[_queue_max];
+    }
+
+    ~CSpscRingQueue()
+    {
+        delete []_elem_array;
+    }
+
+    /** 判断队列是否已满 */
+    bool is_full() const
+    {
+        return size() >= _queue_max;
+    }
+
+    /** 判断队列是否为空 */
+    bool is_empty() const
+    {
+        return 0 == size();
+    }
+
+    /** 返回队首元素，只能由消费者调用 */
+    DataType front() const
+    {
+        return _elem_array[_head & _mask];
+    }
+
+    /***
+      * 弹出队首元素
+      * 注意: 调用pop_front之前应当先使用is_empty判断一下
+      * @return: 返回队首元素
+      */
+    DataType pop_front()
+    {
+        const uint32_t head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+        DataType elem = _elem_array[head & _mask];
+        __atomic_store_n(&_head, head+1, __ATOMIC_RELEASE);
+        return elem;
+    }
+
+    /***
+      * 往队尾插入一个元素
+      * 注意: 调用push_back之前应当先使用is_full判断一下
+      */
+    void push_back(DataType elem)
+    {
+        const uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+        _elem_array[tail & _mask] = elem;
+        __atomic_store_n(&_tail, tail+1, __ATOMIC_RELEASE);
+    }
+
+    /***
+      * 尝试往队尾插入一个元素，无需外部加锁
+      * @return: 如果队列已满则返回false，否则返回true
+      */
+    bool try_push(DataType elem)
+    {
+        const uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+        const uint32_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= _queue_max)
+            return false;
+
+        _elem_array[tail & _mask] = elem;
+        __atomic_store_n(&_tail, tail+1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /***
+      * 尝试弹出队首元素，无需外部加锁
+      * @return: 如果队列为空则返回false，否则返回true
+      */
+    bool try_pop(DataType& elem)
+    {
+        const uint32_t head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+        const uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+            return false;
+
+        elem = _elem_array[head & _mask];
+        __atomic_store_n(&_head, head+1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** 得到队列中存储的元素个数 */
+    uint32_t size() const
+    {
+        const uint32_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        const uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+        return tail - head;
+    }
+
+    /** 得到队列的容量 */
+    uint32_t capacity() const
+    {
+        return _queue_max;
+    }
+
+private:
+    CSpscRingQueue(const CSpscRingQueue&);
+    CSpscRingQueue& operator =(const CSpscRingQueue&);
+
+private:
+    char _pad0[CACHE_LINE_SIZE];
+    uint32_t _head; /** 队首，只被消费者修改 */
+    char _pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t _tail; /** 队尾，只被生产者修改 */
+    char _pad2[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t _queue_max; /** 队列容量，总是2的幂 */
+    uint32_t _mask;      /** 等于_queue_max-1 */
+    DataType* _elem_array;
+};
+
+/***
+  * 多生产者多消费者（MPMC）无锁有界环形队列
+  * 每个槽位带一个序号，生产者和消费者各自通过CAS抢占下标，不需要任何锁
+  */
+template <typename DataType>
+class CMpmcRingQueue
+{
+public:
+    /** 队列中的元素数据类型 */
+    typedef DataType _DataType;
+
+    /***
+      * 构造一个MPMC环形队列
+      * @queue_max: 队列大小，实际容量为不小于queue_max的2的幂
+      */
+    CMpmcRingQueue(uint32_t queue_max)
+        :_head(0)
+        ,_tail(0)
+    {
+        _queue_max = round_up_power_of_two(queue_max);
+        _mask = _queue_max - 1;
+        _cell_array = new Cell[_queue_max];
+        for (uint32_t i=0; i<_queue_max; ++i)
+            _cell_array[i].sequence = i;
+    }
+
+    ~CMpmcRingQueue()
+    {
+        delete []_cell_array;
+    }
+
+    /** 判断队列是否已满，并发时结果仅供参考 */
+    bool is_full() const
+    {
+        return size() >= _queue_max;
+    }
+
+    /** 判断队列是否为空，并发时结果仅供参考 */
+    bool is_empty() const
+    {
+        return 0 == size();
+    }
+
+    /***
+      * 返回队首元素
+      * 仅当只有一个消费者或外部加锁（如CEventQueue中）时结果才可靠
+      */
+    DataType front() const
+    {
+        const uint32_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        return _cell_array[head & _mask].data;
+    }
+
+    /***
+      * 弹出队首元素
+      * 注意: 调用pop_front之前应当先使用is_empty判断一下
+      * @return: 返回队首元素
+      */
+    DataType pop_front()
+    {
+        DataType elem;
+        while (!try_pop(elem));
+        return elem;
+    }
+
+    /***
+      * 往队尾插入一个元素
+      * 注意: 调用push_back之前应当先使用is_full判断一下
+      */
+    void push_back(DataType elem)
+    {
+        while (!try_push(elem));
+    }
+
+    /***
+      * 尝试往队尾插入一个元素，可被多个线程同时调用
+      * @return: 如果队列已满则返回false，否则返回true
+      */
+    bool try_push(DataType elem)
+    {
+        Cell* cell;
+        uint32_t pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+
+        for (;;)
+        {
+            cell = &_cell_array[pos & _mask];
+            const uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            const int32_t diff = static_cast<int32_t>(sequence - pos);
+
+            if (0 == diff)
+            {
+                // 失败时，pos被更新为_tail的最新值
+                if (__atomic_compare_exchange_n(&_tail, &pos, pos+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // 已满
+            }
+            else
+            {
+                pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+            }
+        }
+
+        cell->data = elem;
+        __atomic_store_n(&cell->sequence, pos+1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /***
+      * 尝试弹出队首元素，可被多个线程同时调用
+      * @return: 如果队列为空则返回false，否则返回true
+      */
+    bool try_pop(DataType& elem)
+    {
+        Cell* cell;
+        uint32_t pos = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+
+        for (;;)
+        {
+            cell = &_cell_array[pos & _mask];
+            const uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            const int32_t diff = static_cast<int32_t>(sequence - (pos+1));
+
+            if (0 == diff)
+            {
+                if (__atomic_compare_exchange_n(&_head, &pos, pos+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // 为空
+            }
+            else
+            {
+                pos = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+            }
+        }
+
+        elem = cell->data;
+        __atomic_store_n(&cell->sequence, pos+_mask+1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** 得到队列中存储的元素个数，并发时结果仅供参考 */
+    uint32_t size() const
+    {
+        const uint32_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        const uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+        const int32_t n = static_cast<int32_t>(tail - head);
+        return (n < 0)? 0: static_cast<uint32_t>(n);
+    }
+
+    /** 得到队列的容量 */
+    uint32_t capacity() const
+    {
+        return _queue_max;
+    }
+
+private:
+    CMpmcRingQueue(const CMpmcRingQueue&);
+    CMpmcRingQueue& operator =(const CMpmcRingQueue&);
+
+private:
+    struct Cell
+    {
+        uint32_t sequence;
+        DataType data;
+    };
+
+private:
+    char _pad0[CACHE_LINE_SIZE];
+    uint32_t _head; /** 队首，被消费者竞争 */
+    char _pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t _tail; /** 队尾，被生产者竞争 */
+    char _pad2[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t _queue_max; /** 队列容量，总是2的幂 */
+    uint32_t _mask;      /** 等于_queue_max-1 */
+    Cell* _cell_array;
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_RING_QUEUE_H
@@ -0,0 +1,110 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_ROARING_BITMAP_H
+#define MOOON_UTILS_ROARING_BITMAP_H
+#include "mooon/utils/bitmap.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 压缩位图（Roaring），存放uint32_t的集合，用于稀疏或分布不均的大集合，
+  * 如用户ID的分群：
+  * 值按高16位分成多个容器，每个容器存放低16位，
+  * 元素不超过4096个时为有序的uint16_t数组，超过时为65536位的位图（8KB），
+  * 因此每个元素最多占2字节，密集时每个元素不到1位。
+  *
+  * 容器间的运算按类型选择：数组和数组归并（大小悬殊时二分查找），
+  * 数组和位图逐个测试，位图和位图以CBitmap的字数组运算（AVX2）。
+  * 每次修改后容器总是保持在较小的表示形式。
+  * 非线程安全。
+  */
+class CRoaringBitmap
+{
+public:
+    /***
+      * 加入一个值
+      * @return: 已存在时返回false
+      */
+    bool add(uint32_t value);
+
+    /** 加入[begin, end)的所有值 */
+    void add_range(uint32_t begin, uint64_t end);
+
+    /***
+      * 删除一个值
+      * @return: 不存在时返回false
+      */
+    bool remove(uint32_t value);
+
+    bool contains(uint32_t value) const;
+
+    /** 元素个数 */
+    uint64_t size() const;
+    bool empty() const { return _containers.empty(); }
+    void clear() { _containers.clear(); }
+
+    /** 以下为集合运算，结果存放在本对象 */
+    CRoaringBitmap& operator &=(const CRoaringBitmap& other);
+    CRoaringBitmap& operator |=(const CRoaringBitmap& other);
+    /** 差集，去掉other中有的 */
+    CRoaringBitmap& and_not(const CRoaringBitmap& other);
+
+    /** 交集的元素个数，不生成交集 */
+    uint64_t and_count(const CRoaringBitmap& other) const;
+
+    bool operator ==(const CRoaringBitmap& other) const;
+    bool operator !=(const CRoaringBitmap& other) const { return !(*this == other); }
+
+    /** 按从小到大的顺序取出所有值 */
+    void to_vector(std::vector<uint32_t>* values) const;
+
+    /** 转成定长位图，不小于bitmap->size()的值被忽略 */
+    void to_bitmap(CBitmap* bitmap) const;
+
+    /** 容器占用的字节数（不含std::vector的额外开销），用于估算内存 */
+    size_t get_memory_size() const;
+
+public:
+    enum
+    {
+        ARRAY_MAX_SIZE = 4096,          /** 数组容器的最多元素，超过时转成位图容器，此时两者大小相同 */
+        BITMAP_WORDS = 65536 / 64       /** 位图容器的字数 */
+    };
+
+    struct Container
+    {
+        uint16_t key;                   /** 值的高16位 */
+        uint32_t cardinality;
+        std::vector<uint16_t> array;    /** 数组容器，有序 */
+        std::vector<uint64_t> bitmap;   /** 位图容器，非空时为位图容器 */
+
+        Container(uint16_t key_=0): key(key_), cardinality(0) {}
+        bool is_bitmap() const { return !bitmap.empty(); }
+    };
+
+private:
+    Container* find_container(uint16_t key);
+    const Container* find_container(uint16_t key) const;
+    Container* get_container(uint16_t key);
+
+private:
+    std::vector<Container> _containers; /** 按key有序 */
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_ROARING_BITMAP_H
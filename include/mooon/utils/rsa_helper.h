@@ -22,6 +22,7 @@
 #include "mooon/utils/string_utils.h"
 #include <stdarg.h>
 #include <stdint.h>
+#include <vector>
 UTILS_NAMESPACE_BEGIN
 
 // RSA填充模式
@@ -59,10 +60,19 @@ enum RSAPaddingMode
 // RSA是他们三人姓氏开头字母拼在一起组成
 class CRSAHelper
 {
+    friend class CRSAKey;
+
 public:
     // pub_keyfile 存储了公钥的文件
     // priv_keyfile 存储了私钥的文件
     // 如果出错，则抛出异常mooon::utils::CException
+    //
+    // 解析后的密钥按文件名（或PEM内容）缓存，文件的修改时间变化时重新解析，
+    // 因此重复调用时不再每次读文件和解析PEM，但仍需一次stat，
+    // 频繁调用时更好的是直接使用CRSAKey
+    //
+    // 加密时instr的长度不能超过RSA_size减去填充的开销（PKCS1为11字节，OAEP为41字节），
+    // 解密时instr为RSA_size字节的密文
     static void public_encrypt_bykeyfile(const std::string& pub_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode);
     static void private_decrypt_bykeyfile(const std::string& priv_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode);
     static void private_encrypt_bykeyfile(const std::string& priv_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode);
@@ -78,6 +88,53 @@ private:
     static void private_decrypt(void* rsa, const std::string& instr, std::string* outstr, RSAPaddingMode mode);
     static void private_encrypt(void* rsa, const std::string& instr, std::string* outstr, RSAPaddingMode mode);
     static void public_decrypt(void* rsa, const std::string& instr, std::string* outstr, RSAPaddingMode mode);
+
+    // 从缓存中取得密钥，不存在或文件已修改时解析，返回的RSA已增加引用计数，用完须RSA_free
+    static void* get_cached_key(const std::string& key_or_keyfile, bool is_private, bool is_file);
+};
+
+// 解析一次后可重复使用的RSA密钥，解析出错时抛出异常mooon::utils::CException，
+// 加解密为const操作，可以被多个线程同时使用
+//
+// 使用示例：
+// CRSAKey key;
+// key.load_private_keyfile("abc.key");
+// key.private_decrypt(token, &plain, PKCS1_PADDING);
+class CRSAKey
+{
+public:
+    CRSAKey();
+    ~CRSAKey();
+
+    void load_public_key(const std::string& pub_key);
+    void load_private_key(const std::string& priv_key);
+    void load_public_keyfile(const std::string& pub_keyfile);
+    void load_private_keyfile(const std::string& priv_keyfile);
+
+    bool is_loaded() const { return _rsa != NULL; }
+    bool is_private() const { return _is_private; }
+
+    // 返回RSA模数的字节数，即密文的长度
+    int size() const;
+
+    void public_encrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const;
+    void private_decrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const;
+    void private_encrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const;
+    void public_decrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const;
+
+    // 批量加解密，outstrs的第i个对应instrs的第i个，任何一个出错时抛出异常
+    void public_encrypt(const std::vector<std::string>& instrs, std::vector<std::string>* outstrs, RSAPaddingMode mode) const;
+    void private_decrypt(const std::vector<std::string>& instrs, std::vector<std::string>* outstrs, RSAPaddingMode mode) const;
+
+private:
+    CRSAKey(const CRSAKey&);
+    CRSAKey& operator =(const CRSAKey&);
+    void reset(void* rsa, bool is_private);
+    void check_loaded() const;
+
+private:
+    void* _rsa; // RSA
+    bool _is_private;
 };
 
 UTILS_NAMESPACE_END
@@ -21,6 +21,7 @@
 #include "mooon/utils/string_utils.h"
 #include <stdarg.h>
 #include <stdint.h>
+#include <sys/uio.h>
 UTILS_NAMESPACE_BEGIN
 
 enum SHAType
@@ -50,6 +51,9 @@ public:
     void update(const char* str, size_t size);
     void update(const std::string& str);
 
+    /** 依次对iov中的各段数据求SHA，等同于对它们拼接后的数据求SHA，但不需要拼接 */
+    void update(const struct iovec* iov, int iovcnt);
+
 public:
     void to_string(std::string* str, bool uppercase=true) const;
     std::string to_string(bool uppercase=true) const;
@@ -0,0 +1,218 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_SKETCH_H
+#define MOOON_UTILS_SKETCH_H
+#include "mooon/utils/hash_utils.h"
+#include <string>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 概率数据结构（布隆过滤器、布谷鸟过滤器、count-min sketch和HyperLogLog）的存储，
+  * 序列化格式为64字节的头部加数据，数据的格式就是内存中的格式，
+  * 因此可将序列化结果写入文件，之后mmap该文件并attach，不需要解析和复制，
+  * 多个进程以MAP_SHARED映射同一个文件时看到同一份数据（但不同进程同时修改需要外部同步）。
+  * 数据按小端存放，只能在相同字节序的机器间交换。
+  */
+typedef enum
+{
+    sketch_bloom_filter = 1,
+    sketch_cuckoo_filter = 2,
+    sketch_count_min = 3,
+    sketch_hyperloglog = 4
+}sketch_type_t;
+
+/** 序列化的头部，数据紧随其后，头部为64字节，mmap时数据按缓存行对齐 */
+struct sketch_header_t
+{
+    uint32_t magic;      /** SKETCH_MAGIC */
+    uint16_t type;       /** sketch_type_t */
+    uint16_t version;
+    uint64_t data_size;  /** 数据的字节数 */
+    uint64_t params[4];  /** 各结构的参数 */
+    uint64_t reserved[2];
+};
+
+class CSketchStorage
+{
+public:
+    enum { SKETCH_MAGIC = 0x544B534D, SKETCH_VERSION = 1 }; // "MSKT"
+
+public:
+    virtual ~CSketchStorage();
+
+    /** 序列化后的字节数 */
+    size_t get_serialized_size() const { return sizeof(sketch_header_t) + _data_size; }
+
+    /** 序列化到buffer，其大小不能小于get_serialized_size() */
+    void serialize(void* buffer) const;
+
+    /** 序列化到字符串，可写入文件或Redis */
+    std::string serialize() const;
+
+    /***
+      * 直接使用buffer中序列化的数据（如mmap的文件），不复制，之后的修改直接写入buffer，
+      * buffer须在本对象使用期间一直有效，且按8字节对齐
+      * @return: 类型、版本或大小不符时返回false，本对象不变
+      */
+    bool attach(void* buffer, size_t size);
+
+    /***
+      * 从序列化的数据复制
+      * @return: 类型、版本或大小不符时返回false，本对象不变
+      */
+    bool load(const void* buffer, size_t size);
+
+    /** 数据是否为attach的外部内存 */
+    bool is_attached() const { return _attached; }
+
+    /** 是否已创建或attach、load，默认构造的对象须在attach或load后才能使用 */
+    bool is_valid() const { return _data != NULL; }
+
+    /** 所有数据清零 */
+    void clear();
+
+protected:
+    CSketchStorage(sketch_type_t type);
+
+    /** 分配data_size字节清零的数据，按缓存行对齐，参数须已设置到_params */
+    void create(size_t data_size);
+
+    /***
+      * 以头部中的参数设置派生类的状态，attach和load时调用，此时_data还未改变
+      * @return: 参数不合法或和data_size不符时返回false
+      */
+    virtual bool restore(const uint64_t* params, size_t data_size) = 0;
+
+    /** 合并时判断参数是否相同 */
+    bool same_shape(const CSketchStorage& other) const;
+
+private:
+    CSketchStorage(const CSketchStorage&);
+    CSketchStorage& operator =(const CSketchStorage&);
+
+    bool check(const void* buffer, size_t size, sketch_header_t* header);
+    void release();
+
+protected:
+    uint64_t _params[4];
+    uint8_t* _data;
+    size_t _data_size;
+
+private:
+    const sketch_type_t _type;
+    bool _attached;
+};
+
+/***
+  * count-min sketch，估计每个键的出现次数，估计值只会偏大，不会偏小，
+  * 用于热点键的发现：以depth行、每行width个32位计数器存放，估计值为各行对应计数器的最小值，
+  * 以概率1-delta，误差不超过总次数的epsilon倍。
+  * 采用保守更新（只增加等于最小值的计数器），偏大的误差明显更小；
+  * halve用于衰减，使估计值反映最近一段时间的访问。
+  * 非线程安全。
+  */
+class CCountMinSketch: public CSketchStorage
+{
+public:
+    /** 默认构造的须attach或load后才能使用 */
+    CCountMinSketch();
+
+    /***
+      * @epsilon: 相对误差，宽度为e/epsilon（取整为2的幂）
+      * @delta: 误差超出的概率，深度为ln(1/delta)，不超过16
+      */
+    CCountMinSketch(double epsilon, double delta);
+
+    /***
+      * 增加键的次数，二进制的键以CHashUtils::xxhash64求哈希后调用add_hash
+      * （不提供add(const void*, size_t, uint32_t)，避免add("key", 100)被匹配为它）
+      * @return: 增加后的估计值
+      */
+    uint32_t add(const std::string& key, uint32_t count=1) { return add_hash(CHashUtils::xxhash64(key), count); }
+    uint32_t add_hash(uint64_t hash, uint32_t count=1);
+
+    uint32_t estimate(const void* key, size_t size) const { return estimate_hash(CHashUtils::xxhash64(key, size)); }
+    uint32_t estimate(const std::string& key) const { return estimate_hash(CHashUtils::xxhash64(key)); }
+    uint32_t estimate_hash(uint64_t hash) const;
+
+    /** 所有计数器减半，总次数也减半 */
+    void halve();
+
+    /***
+      * 加上另一个sketch的计数，宽度和深度须相同
+      * @return: 形状不同时返回false
+      */
+    bool merge(const CCountMinSketch& other);
+
+    uint32_t get_width() const { return _width; }
+    uint32_t get_depth() const { return _depth; }
+
+    /** 累计增加的总次数，饱和于UINT64_MAX */
+    uint64_t get_total() const;
+
+private:
+    virtual bool restore(const uint64_t* params, size_t data_size);
+    uint32_t* get_row(uint32_t row) const { return reinterpret_cast<uint32_t*>(_data) + 2 + static_cast<size_t>(row) * _width; }
+
+private:
+    uint32_t _width;
+    uint32_t _depth;
+};
+
+/***
+  * HyperLogLog，估计不同元素的个数（基数），每个寄存器1字节，
+  * 精度precision时有2^precision个寄存器，标准误差约为1.04/sqrt(2^precision)，
+  * 如14时16KB，误差约0.8%；小基数时使用线性计数修正。
+  * 同精度的可以合并（取各寄存器的最大值），例如按分钟统计UV后合并为按小时的。
+  * 非线程安全。
+  */
+class CHyperLogLog: public CSketchStorage
+{
+public:
+    /** 默认构造的须attach或load后才能使用 */
+    CHyperLogLog();
+
+    /** @precision: 4到18 */
+    explicit CHyperLogLog(uint32_t precision);
+
+    /***
+      * 加入一个元素
+      * @return: 寄存器被改变时返回true，即基数估计可能变化
+      */
+    bool add(const void* key, size_t size) { return add_hash(CHashUtils::xxhash64(key, size)); }
+    bool add(const std::string& key) { return add_hash(CHashUtils::xxhash64(key)); }
+    bool add_hash(uint64_t hash);
+
+    /** 估计的基数 */
+    uint64_t estimate() const;
+
+    /** 合并另一个，精度须相同，形状不同时返回false */
+    bool merge(const CHyperLogLog& other);
+
+    uint32_t get_precision() const { return _precision; }
+
+private:
+    virtual bool restore(const uint64_t* params, size_t data_size);
+
+private:
+    uint32_t _precision;
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_SKETCH_H
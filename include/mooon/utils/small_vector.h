@@ -0,0 +1,247 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_SMALL_VECTOR_H
+#define MOOON_UTILS_SMALL_VECTOR_H
+#include "mooon/utils/config.h"
+#include <new>
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 小缓冲优化的vector，不超过N个元素时存储在对象内部，不分配内存，
+  * 超过时才转到堆上，接口为std::vector的常用子集，
+  * 适用于元素个数通常很少的场景，如直方图的柱和解析出的少量字段
+  *
+  * 与std::vector的区别：swap和移动会逐个移动内部存储的元素，
+  * 扩容后迭代器、指针和引用失效
+  */
+template <typename T, size_t N>
+class CSmallVector
+{
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef size_t size_type;
+
+public:
+    CSmallVector()
+        : _data(inline_data()), _size(0), _capacity(N)
+    {
+    }
+
+    CSmallVector(const CSmallVector& other)
+        : _data(inline_data()), _size(0), _capacity(N)
+    {
+        reserve(other._size);
+        for (size_t i=0; i<other._size; ++i)
+            new (_data+i) T(other._data[i]);
+        _size = other._size;
+    }
+
+#if __cplusplus >= 201103L
+    CSmallVector(CSmallVector&& other)
+        : _data(inline_data()), _size(0), _capacity(N)
+    {
+        steal(other);
+    }
+
+    CSmallVector& operator =(CSmallVector&& other)
+    {
+        if (this != &other)
+        {
+            destroy();
+            _data = inline_data();
+            _size = 0;
+            _capacity = N;
+            steal(other);
+        }
+        return *this;
+    }
+#endif // __cplusplus >= 201103L
+
+    CSmallVector& operator =(const CSmallVector& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            reserve(other._size);
+            for (size_t i=0; i<other._size; ++i)
+                new (_data+i) T(other._data[i]);
+            _size = other._size;
+        }
+        return *this;
+    }
+
+    ~CSmallVector()
+    {
+        destroy();
+    }
+
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+    bool empty() const { return 0 == _size; }
+
+    /** 判断是否存储在对象内部 */
+    bool is_inline() const { return _data == inline_data(); }
+
+    T* data() { return _data; }
+    const T* data() const { return _data; }
+    iterator begin() { return _data; }
+    iterator end() { return _data + _size; }
+    const_iterator begin() const { return _data; }
+    const_iterator end() const { return _data + _size; }
+
+    T& operator [](size_t i) { return _data[i]; }
+    const T& operator [](size_t i) const { return _data[i]; }
+    T& front() { return _data[0]; }
+    const T& front() const { return _data[0]; }
+    T& back() { return _data[_size-1]; }
+    const T& back() const { return _data[_size-1]; }
+
+    void push_back(const T& value)
+    {
+        if (_size == _capacity)
+        {
+            // value可能是本vector中的元素，扩容前先复制
+            T copy(value);
+            grow(_capacity * 2);
+            new (_data+_size) T(copy);
+        }
+        else
+        {
+            new (_data+_size) T(value);
+        }
+        ++_size;
+    }
+
+    void pop_back()
+    {
+        _data[--_size].~T();
+    }
+
+    /** 在pos前插入一个元素，后面的元素后移，返回指向插入元素的迭代器 */
+    iterator insert(iterator pos, const T& value)
+    {
+        const size_t index = pos - begin();
+        T copy(value);
+        push_back(copy);
+        for (size_t i=_size-1; i>index; --i)
+            _data[i] = _data[i-1];
+        _data[index] = copy;
+        return begin() + index;
+    }
+
+    /** 删除一个元素，后面的元素前移，返回指向下一个元素的迭代器 */
+    iterator erase(iterator pos)
+    {
+        for (iterator iter=pos; iter+1<end(); ++iter)
+            *iter = *(iter + 1);
+        pop_back();
+        return pos;
+    }
+
+    void clear()
+    {
+        for (size_t i=0; i<_size; ++i)
+            _data[i].~T();
+        _size = 0;
+    }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity > _capacity)
+            grow(capacity);
+    }
+
+    void resize(size_t size, const T& value=T())
+    {
+        while (_size > size)
+            pop_back();
+        reserve(size);
+        while (_size < size)
+            new (_data+_size++) T(value);
+    }
+
+private:
+    T* inline_data() { return reinterpret_cast<T*>(_buffer); }
+    const T* inline_data() const { return reinterpret_cast<const T*>(_buffer); }
+
+    void grow(size_t capacity)
+    {
+        T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for (size_t i=0; i<_size; ++i)
+        {
+#if __cplusplus >= 201103L
+            new (data+i) T(static_cast<T&&>(_data[i]));
+#else
+            new (data+i) T(_data[i]);
+#endif // __cplusplus >= 201103L
+            _data[i].~T();
+        }
+
+        if (!is_inline())
+            ::operator delete(_data);
+        _data = data;
+        _capacity = capacity;
+    }
+
+    void destroy()
+    {
+        clear();
+        if (!is_inline())
+            ::operator delete(_data);
+    }
+
+#if __cplusplus >= 201103L
+    // 对方在堆上时直接接管，否则逐个移动
+    void steal(CSmallVector& other)
+    {
+        if (other.is_inline())
+        {
+            for (size_t i=0; i<other._size; ++i)
+                new (_data+i) T(static_cast<T&&>(other._data[i]));
+            _size = other._size;
+            other.clear();
+        }
+        else
+        {
+            _data = other._data;
+            _size = other._size;
+            _capacity = other._capacity;
+            other._data = other.inline_data();
+            other._size = 0;
+            other._capacity = N;
+        }
+    }
+#endif // __cplusplus >= 201103L
+
+private:
+    T* _data;
+    size_t _size;
+    size_t _capacity;
+    union
+    {
+        char _buffer[N * sizeof(T)];
+        long double _align; // 保证对齐
+        void* _align_pointer;
+    };
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_SMALL_VECTOR_H
@@ -70,36 +70,36 @@ extern "C" int main()
 class StringFormatter
 {
 public:
-    // 使用简单，固化buffer_size
+    // 不超过inline_size时格式化到对象内部，只需一次vsnprintf且不分配内存
     explicit StringFormatter(const char* format, ...) __attribute__((format(printf, 2, 3)))
     {
-        size_t size = 1024;
         va_list ap;
 
-        _buffer.reset(new char[size]);
-        while (true)
+        va_start(ap, format);
+        int expected = vsnprintf(_inline_buffer, sizeof(_inline_buffer), format, ap);
+        va_end(ap);
+
+        _str = _inline_buffer;
+        if (expected < 0)
+        {
+            _inline_buffer[0] = '\0';
+        }
+        else if (expected >= static_cast<int>(sizeof(_inline_buffer)))
         {
+            /* Try again with precisely what is needed. */
+            const size_t size = static_cast<size_t>(expected) + 1;
+            _buffer.reset(new char[size]);
+
             va_start(ap, format);
-            int excepted = vsnprintf(_buffer.get(), size, format, ap);
+            (void)vsnprintf(_buffer.get(), size, format, ap);
             va_end(ap);
-
-            /* If that worked, return the string. */
-            if (excepted > -1 && excepted < (int)size)
-                break;
-
-            /* Else try again with more space. */
-            if (excepted > -1)    /* glibc 2.1 */
-                size = (size_t)excepted + 1; /* precisely what is needed */
-            else           /* glibc 2.0 */
-                size *= 2;  /* twice the old size */
-
-            _buffer.reset(new char[size]);
+            _str = _buffer.get();
         }
     }
 
     const char* c_str() const throw ()
     {
-        return _buffer.get();
+        return _str;
     }
 
 private:
@@ -110,7 +110,10 @@ private:
     bool operator !=(const StringFormatter&) const;
 
 private:
+    enum { inline_size = 256 };
+    char _inline_buffer[inline_size];
     ScopedArray<char> _buffer;
+    const char* _str;
 };
 
 UTILS_NAMESPACE_END
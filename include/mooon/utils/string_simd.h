@@ -0,0 +1,118 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_STRING_SIMD_H
+#define MOOON_UTILS_STRING_SIMD_H
+#include "mooon/utils/config.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * CStringUtils中逐字节处理函数的向量化实现，
+  * 第一次使用时按CPU支持的指令集（AVX2、SSE4.2）选择实现，都不支持时使用逐字节的标量实现，
+  * 各实现的结果完全相同，只是速度不同
+  */
+class CStringSimd
+{
+public:
+    typedef enum
+    {
+        isa_scalar = 0, // 逐字节
+        isa_sse42 = 1,  // 一次16字节
+        isa_avx2 = 2    // 一次32字节
+    }isa_t;
+
+    /** 得到当前使用的指令集 */
+    static isa_t get_isa();
+
+    /** 得到CPU支持的最高指令集 */
+    static isa_t get_supported_isa();
+
+    /***
+      * 强制使用指定的指令集，超出CPU支持时使用CPU支持的最高指令集，
+      * 非线程安全，仅用于测试和性能对比
+      * @return: 实际使用的指令集
+      */
+    static isa_t set_isa(isa_t isa);
+
+    /** 将[str, str+size)中的小写字母转成大写 */
+    static void to_upper(char* str, size_t size);
+
+    /** 将[str, str+size)中的大写字母转成小写 */
+    static void to_lower(char* str, size_t size);
+
+    /** 得到开头连续的空白字符（空格、\t、\r和\n）个数 */
+    static size_t count_leading_spaces(const char* str, size_t size);
+
+    /** 得到去掉结尾连续空白字符后的长度 */
+    static size_t size_without_trailing_spaces(const char* str, size_t size);
+
+    /** 得到开头连续的数字字符个数 */
+    static size_t count_leading_digits(const char* str, size_t size);
+
+    /** 得到开头连续的ASCII字符（最高位为0的字节）个数 */
+    static size_t count_leading_ascii(const char* str, size_t size);
+
+    /** 判断是否全为字母，size为0时返回true */
+    static bool is_alphabetic(const char* str, size_t size);
+
+    /***
+      * 查找第一个等于c1或c2的字节，用于同时找分隔符和引号（或换行和引号）等，
+      * 只找一个字节时glibc的memchr同样是向量化的
+      * @return: 找到的位置，找不到时返回size
+      */
+    static size_t find_first_of(const char* str, size_t size, char c1, char c2);
+
+    /** 统计等于c的字节个数 */
+    static size_t count_char(const char* str, size_t size, char c);
+
+    /***
+      * 查找第一个须按MySQL规则转义的字节（\0、\n、\r、\\、'、"和\032），
+      * @return: 找到的位置，找不到时返回size
+      */
+    static size_t find_mysql_escape(const char* str, size_t size);
+
+    /***
+      * 按mysql_escape_string的规则转义，不须转义的连续字节整段复制，
+      * 只适用于须转义的字节不会出现在多字节字符中间的字符集（如utf8、utf8mb4和latin1，不包括gbk等）
+      * @escaped: 存放结果，大小不能小于size*2，不会添加结尾符
+      * @return: 结果的长度
+      */
+    static size_t escape_mysql(const char* str, size_t size, char* escaped);
+
+    /***
+      * 查找第一个须按JSON规则转义的字节（"、\\和小于0x20的控制字符），
+      * @return: 找到的位置，找不到时返回size
+      */
+    static size_t find_json_escape(const char* str, size_t size);
+
+    /***
+      * 查找第一个不合法的UTF-8字符，超长编码、代理项（U+D800至U+DFFF）、
+      * 大于U+10FFFF的和结尾不完整的字符都不合法，向量实现一次校验16或32字节（包括非ASCII）
+      * @return: 不合法的字符的首字节的位置，合法时返回size
+      */
+    static size_t find_invalid_utf8(const char* str, size_t size);
+
+    /***
+      * 将[str, str+size)转成十六进制字符串
+      * @hex: 存放结果，大小不能小于size*2，不会添加结尾符
+      */
+    static void to_hex(const unsigned char* str, size_t size, char* hex, bool lowercase);
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_STRING_SIMD_H
@@ -28,8 +28,12 @@ UTILS_NAMESPACE_BEGIN
 class CStringUtils
 {
 public:
+    // 结果同zlib的crc32，crc为之前数据的CRC值
     static uint32_t crc32(const std::string& str, uint32_t crc=0);
 
+    // CRC32C（Castagnoli多项式），结果不同于crc32，见CCrc32
+    static uint32_t crc32c(const std::string& str, uint32_t crc=0);
+
     // 反转字符串
     // 输入空则啥也不做，输入单个字符则啥也不做，
     // 输入12则变成21，输入123则变成321，输入1234则变成4321，依次类推。。。
@@ -219,6 +223,29 @@ public:
 
     static std::string int_tostring(uint64_t source);
     static std::string uint64_tostring(uint64_t source);    
+
+    /***
+      * 快速将无符号整数转换成十进制字符串，每次处理两位数字，不使用snprintf
+      * @buffer: 存放结果，至少20字节，不会写入结尾符
+      * @return: 返回写入buffer的字节数
+      */
+    static int uint64_toa(uint64_t source, char* buffer);
+
+    /***
+      * 同uint64_toa，负数带“-”号
+      * @buffer: 存放结果，至少20字节，不会写入结尾符
+      */
+    static int int64_toa(int64_t source, char* buffer);
+
+    /***
+      * 将双精度浮点数转换成能精确还原的最短字符串，如0.1转换成“0.1”，而不是“0.10000000000000001”，
+      * 支持C++17的std::to_chars时不受locale影响
+      * @buffer: 存放结果，至少DOUBLE_TOA_BUFFER_SIZE字节，不会写入结尾符
+      * @return: 返回写入buffer的字节数
+      */
+    static int double_toa(double source, char* buffer);
+    static std::string double_tostring(double source);
+    enum { DOUBLE_TOA_BUFFER_SIZE = 32 };
     
     /** 跳过空格部分
       */
@@ -246,7 +273,21 @@ public:
         return s.str();
     }
 
-    /** 将STL容器转换成字符串 */
+    // 整数不经过stringstream
+    static std::string any2string(int16_t any) { return int_tostring(any); }
+    static std::string any2string(int32_t any) { return int_tostring(any); }
+    static std::string any2string(int64_t any) { return int_tostring(any); }
+    static std::string any2string(uint16_t any) { return int_tostring(any); }
+    static std::string any2string(uint32_t any) { return int_tostring(any); }
+    static std::string any2string(uint64_t any) { return int_tostring(any); }
+
+    // 字符串和浮点数也不经过stringstream，浮点数的结果同stringstream的默认格式（%g）
+    static std::string any2string(const std::string& any) { return any; }
+    static std::string any2string(const char* any) { return any; }
+    static std::string any2string(double any) { char buffer[DOUBLE_TOA_BUFFER_SIZE]; return std::string(buffer, snprintf(buffer, sizeof(buffer), "%g", any)); }
+    static std::string any2string(float any) { return any2string(static_cast<double>(any)); }
+
+    /** 将STL容器转换成字符串，转成JSON数组见json_writer.h中的container2json */
     template <class ContainerClass>
     static std::string container2string(const ContainerClass& container, const std::string& join_string)
     {
@@ -264,7 +305,7 @@ public:
         return str;
     }
     
-    /** 将map容器转换成字符串 */
+    /** 将map容器转换成字符串，转成JSON对象见json_writer.h中的map2json */
     template <class MapClass>
     static std::string map2string(const MapClass& map, const std::string& join_string)
     {
@@ -0,0 +1,325 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_TIMING_WHEEL_H
+#define MOOON_UTILS_TIMING_WHEEL_H
+#include "mooon/utils/timeout_manager.h"
+UTILS_NAMESPACE_BEGIN
+
+/***
+  * 可放入时间轮的对象基类，不应当直接使用此类，而应当总是继承方式，
+  * 内嵌双向链表指针，使得插入、删除和更新都为O(1)
+  */
+class CWheelTimeoutable
+{
+    template <class TimeoutableClass> friend class CTimingWheel;
+
+public:
+    CWheelTimeoutable()
+        :_prev(NULL)
+        ,_next(NULL)
+        ,_expire_tick(0)
+        ,_timeout_milliseconds(0)
+    {
+    }
+
+    /** 是否在时间轮中 */
+    bool in_wheel() const { return _next != NULL; }
+
+    /** 得到本对象的超时毫秒数 */
+    uint32_t get_timeout_milliseconds() const { return _timeout_milliseconds; }
+
+    /** 设置本对象的超时毫秒数，为0时使用时间轮的默认超时 */
+    void set_timeout_milliseconds(uint32_t timeout_milliseconds) { _timeout_milliseconds = timeout_milliseconds; }
+
+private:
+    CWheelTimeoutable* _prev;
+    CWheelTimeoutable* _next;
+    uint64_t _expire_tick; /** 到期的刻度 */
+    uint32_t _timeout_milliseconds;
+};
+
+/***
+  * 分层时间轮，用于替代CTimeoutManager，
+  * 共4层，每层256个槽，最小刻度默认为1毫秒，可表示的最大超时为2^32个刻度（1毫秒时约49.7天），
+  * 每个对象可有自己的超时时长，插入、删除和更新均为O(1)，
+  * 超时回调的接口仍为ITimeoutHandler。
+  * TimeoutableClass要求为CWheelTimeoutable的子类型，
+  * 和CTimeoutManager一样为非线程安全类，通常一个线程一个实例。
+  */
+template <class TimeoutableClass>
+class CTimingWheel
+{
+public:
+    /***
+      * 构造一个时间轮
+      * @tick_milliseconds: 最小刻度的毫秒数
+      */
+    CTimingWheel(uint32_t tick_milliseconds=1)
+        :_tick_milliseconds((0 == tick_milliseconds)? 1: tick_milliseconds)
+        ,_current_tick(0)
+        ,_started(false)
+        ,_default_timeout_milliseconds(0)
+        ,_size(0)
+        ,_timeout_handler(NULL)
+    {
+        for (int level=0; level<WHEEL_LEVELS; ++level)
+        {
+            for (int slot=0; slot<WHEEL_SLOTS; ++slot)
+                init_list(&_wheel[level][slot]);
+        }
+    }
+
+    /** 设置默认超时毫秒数，push时对象本身未设置超时毫秒数时使用 */
+    void set_default_timeout(uint32_t timeout_milliseconds)
+    {
+        _default_timeout_milliseconds = timeout_milliseconds;
+    }
+
+    /** 得到默认超时毫秒数 */
+    uint32_t get_default_timeout() const
+    {
+        return _default_timeout_milliseconds;
+    }
+
+    /** 设置超时处理器 */
+    void set_timeout_handler(ITimeoutHandler<TimeoutableClass>* timeout_handler)
+    {
+        _timeout_handler = timeout_handler;
+    }
+
+    /** 得到时间轮中的对象个数 */
+    uint32_t size() const
+    {
+        return _size;
+    }
+
+    /***
+      * 将对象放入时间轮，如果已在时间轮中，则等同于update
+      * @timeoutable: 指向可超时的对象指针
+      * @current_milliseconds: 当前毫秒时间，应当为单调时钟
+      * @timeout_milliseconds: 超时毫秒数，如果为0则依次使用对象本身的和时间轮默认的超时毫秒数
+      */
+    void push(TimeoutableClass* timeoutable, uint64_t current_milliseconds, uint32_t timeout_milliseconds=0)
+    {
+        CWheelTimeoutable* node = timeoutable;
+        start(current_milliseconds);
+
+        if (node->in_wheel())
+        {
+            unlink(node);
+            --_size;
+        }
+        if (timeout_milliseconds > 0)
+            node->_timeout_milliseconds = timeout_milliseconds;
+        if (0 == node->_timeout_milliseconds)
+            node->_timeout_milliseconds = _default_timeout_milliseconds;
+
+        // 不足一个刻度的按一个刻度计算，保证不会提前超时
+        uint64_t ticks = (node->_timeout_milliseconds + _tick_milliseconds - 1) / _tick_milliseconds;
+        if (0 == ticks) ticks = 1;
+        node->_expire_tick = to_tick(current_milliseconds) + ticks;
+
+        add_node(node);
+        ++_size;
+    }
+
+    /***
+      * 将一个对象从时间轮中删除
+      * @timeoutable: 指向可超时的对象指针
+      */
+    void remove(TimeoutableClass* timeoutable)
+    {
+        CWheelTimeoutable* node = timeoutable;
+        if (node->in_wheel())
+        {
+            unlink(node);
+            --_size;
+        }
+    }
+
+    /***
+      * 以对象自身的超时时长重新计时，如有数据到达时调用
+      */
+    void update(TimeoutableClass* timeoutable, uint64_t current_milliseconds)
+    {
+        push(timeoutable, current_milliseconds, 0);
+    }
+
+    /***
+      * 推进时间轮，对所有已超时的对象回调ITimeoutHandler::on_timeout_event，
+      * 回调前对象已被移出时间轮，回调中可以重新push
+      * @current_milliseconds: 当前毫秒时间，应当为单调时钟
+      */
+    void check_timeout(uint64_t current_milliseconds)
+    {
+        start(current_milliseconds);
+        const uint64_t target_tick = to_tick(current_milliseconds);
+
+        // 到期刻度等于当前刻度的也算超时，处理完后_current_tick指向下一个未处理的刻度
+        while (_current_tick <= target_tick)
+        {
+            // 没有对象时直接跳到目标刻度
+            if (0 == _size)
+            {
+                _current_tick = target_tick + 1;
+                break;
+            }
+
+            const int index = static_cast<int>(_current_tick & WHEEL_MASK);
+            if (0 == index)
+            {
+                // 逐层向下级联，上层到期的槽中的对象重新分配到下层
+                for (int level=1; level<WHEEL_LEVELS; ++level)
+                {
+                    const int slot = static_cast<int>((_current_tick >> (level * WHEEL_BITS)) & WHEEL_MASK);
+                    cascade(level, slot);
+                    if (slot != 0) break;
+                }
+            }
+
+            ++_current_tick;
+            expire(&_wheel[0][index]);
+        }
+    }
+
+private:
+    enum
+    {
+        WHEEL_BITS   = 8,
+        WHEEL_LEVELS = 4,
+        WHEEL_SLOTS  = 1 << WHEEL_BITS,
+        WHEEL_MASK   = WHEEL_SLOTS - 1
+    };
+
+private:
+    uint64_t to_tick(uint64_t milliseconds) const
+    {
+        return milliseconds / _tick_milliseconds;
+    }
+
+    void start(uint64_t current_milliseconds)
+    {
+        if (!_started)
+        {
+            _started = true;
+            _current_tick = to_tick(current_milliseconds);
+        }
+    }
+
+    static void init_list(CWheelTimeoutable* head)
+    {
+        head->_prev = head;
+        head->_next = head;
+    }
+
+    static void link_tail(CWheelTimeoutable* head, CWheelTimeoutable* node)
+    {
+        node->_prev = head->_prev;
+        node->_next = head;
+        head->_prev->_next = node;
+        head->_prev = node;
+    }
+
+    static void unlink(CWheelTimeoutable* node)
+    {
+        node->_prev->_next = node->_next;
+        node->_next->_prev = node->_prev;
+        node->_prev = NULL;
+        node->_next = NULL;
+    }
+
+    // 将slot链表整体移到local链表，原slot变为空
+    static void splice(CWheelTimeoutable* slot, CWheelTimeoutable* local)
+    {
+        init_list(local);
+        if (slot->_next != slot)
+        {
+            local->_next = slot->_next;
+            local->_prev = slot->_prev;
+            local->_next->_prev = local;
+            local->_prev->_next = local;
+            init_list(slot);
+        }
+    }
+
+    void add_node(CWheelTimeoutable* node)
+    {
+        uint64_t expire_tick = node->_expire_tick;
+        uint64_t delta = (expire_tick > _current_tick)? expire_tick - _current_tick: 0;
+
+        // 超出最大范围的，放在最高层最远的槽中
+        const uint64_t max_delta = (static_cast<uint64_t>(1) << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+        if (delta > max_delta)
+        {
+            delta = max_delta;
+            expire_tick = _current_tick + delta;
+        }
+
+        int level = 0;
+        while ((level < WHEEL_LEVELS-1) && (delta >= (static_cast<uint64_t>(1) << ((level+1) * WHEEL_BITS))))
+            ++level;
+
+        const int slot = (0 == delta)?
+            static_cast<int>(_current_tick & WHEEL_MASK):
+            static_cast<int>((expire_tick >> (level * WHEEL_BITS)) & WHEEL_MASK);
+        link_tail(&_wheel[level][slot], node);
+    }
+
+    void cascade(int level, int slot)
+    {
+        CWheelTimeoutable local;
+        splice(&_wheel[level][slot], &local);
+
+        while (local._next != &local)
+        {
+            CWheelTimeoutable* node = local._next;
+            unlink(node);
+            add_node(node);
+        }
+    }
+
+    void expire(CWheelTimeoutable* slot)
+    {
+        CWheelTimeoutable local;
+        splice(slot, &local);
+
+        // 回调中可能删除local中的其它对象或重新push，每次都从头取
+        while (local._next != &local)
+        {
+            CWheelTimeoutable* node = local._next;
+            unlink(node);
+            --_size;
+
+            if (_timeout_handler != NULL)
+                _timeout_handler->on_timeout_event(static_cast<TimeoutableClass*>(node));
+        }
+    }
+
+private:
+    uint64_t _tick_milliseconds;
+    uint64_t _current_tick;
+    bool _started;
+    uint32_t _default_timeout_milliseconds;
+    uint32_t _size;
+    ITimeoutHandler<TimeoutableClass>* _timeout_handler;
+    CWheelTimeoutable _wheel[WHEEL_LEVELS][WHEEL_SLOTS]; /** 每个槽为带哨兵的循环双向链表 */
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_TIMING_WHEEL_H
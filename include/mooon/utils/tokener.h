@@ -18,14 +18,24 @@
  *
  * CTokener：普通的Token解析器，每个Token之间可以单个或多个字符分隔
  * CEnhancedTokener：可用来解析URL参数形式的
+ * CEnhancedTokenerView：同CEnhancedTokener，但不复制，适合解析HTTP请求的查询串
  */
 #ifndef MOOON_UTILS_TOKENER_H
 #define MOOON_UTILS_TOKENER_H
+#include "mooon/utils/codec.h"
+#include "mooon/utils/flat_hash_map.h"
+#include "mooon/utils/small_vector.h"
+#include "mooon/utils/string_simd.h"
 #include "mooon/utils/string_utils.h"
 #include <list>
 #include <map>
 #include <string>
+#include <string.h>
+#include <utility>
 #include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif // __cplusplus >= 201703L
 UTILS_NAMESPACE_BEGIN
 
 class CTokener
@@ -42,48 +52,135 @@ public:
     template <class ContainerType>
     static int split(ContainerType* tokens, const std::string& source, const std::string& sep, bool skip_sep=false)
     {
-        if (sep.empty())
+        StringOutput<ContainerType> output(tokens, source.data());
+        (void)do_split(output, source.data(), source.size(), sep.data(), sep.size(), skip_sep);
+        return static_cast<int>(tokens->size());
+    }
+
+    /***
+      * 同split，但不复制任何数据，只将各Token在source中的位置存入tokens，
+      * 元素类型为std::pair<size_t, size_t>，first为偏移，second为长度，
+      * 只扫描source一遍，分隔符为单个字符时使用memchr查找
+      * @return: 本次解析出的Token个数
+      */
+    template <class ContainerType>
+    static int split_offsets(ContainerType* tokens, const char* source, size_t source_size, const char* sep, size_t sep_size, bool skip_sep=false)
+    {
+        OffsetOutput<ContainerType> output(tokens);
+        return do_split(output, source, source_size, sep, sep_size, skip_sep);
+    }
+
+    template <class ContainerType>
+    static int split_offsets(ContainerType* tokens, const std::string& source, const std::string& sep, bool skip_sep=false)
+    {
+        return split_offsets(tokens, source.data(), source.size(), sep.data(), sep.size(), skip_sep);
+    }
+
+#if __cplusplus >= 201703L
+    /***
+      * 同split_offsets，但存入指向source的std::string_view，
+      * source须在tokens使用期间保持有效
+      */
+    template <class ContainerType>
+    static int split_views(ContainerType* tokens, std::string_view source, std::string_view sep, bool skip_sep=false)
+    {
+        ViewOutput<ContainerType> output(tokens, source.data());
+        return do_split(output, source.data(), source.size(), sep.data(), sep.size(), skip_sep);
+    }
+#endif // __cplusplus >= 201703L
+
+private:
+    template <class ContainerType>
+    struct StringOutput
+    {
+        ContainerType* tokens;
+        const char* source;
+
+        StringOutput(ContainerType* tokens_, const char* source_): tokens(tokens_), source(source_) {}
+        void operator ()(size_t offset, size_t length) { tokens->push_back(std::string(source+offset, length)); }
+    };
+
+    template <class ContainerType>
+    struct OffsetOutput
+    {
+        ContainerType* tokens;
+
+        OffsetOutput(ContainerType* tokens_): tokens(tokens_) {}
+        void operator ()(size_t offset, size_t length) { tokens->push_back(std::make_pair(offset, length)); }
+    };
+
+#if __cplusplus >= 201703L
+    template <class ContainerType>
+    struct ViewOutput
+    {
+        ContainerType* tokens;
+        const char* source;
+
+        ViewOutput(ContainerType* tokens_, const char* source_): tokens(tokens_), source(source_) {}
+        void operator ()(size_t offset, size_t length) { tokens->push_back(std::string_view(source+offset, length)); }
+    };
+#endif // __cplusplus >= 201703L
+
+    // 在[begin, end)中查找sep，找不到返回NULL
+    static const char* find_sep(const char* begin, const char* end, const char* sep, size_t sep_size)
+    {
+        if (1 == sep_size)
+            return static_cast<const char*>(memchr(begin, sep[0], end-begin));
+
+        // 先以memchr找首字符，再比较余下的
+        while (static_cast<size_t>(end-begin) >= sep_size)
+        {
+            const char* found = static_cast<const char*>(memchr(begin, sep[0], end-begin-sep_size+1));
+            if (NULL == found)
+                break;
+            if (0 == memcmp(found+1, sep+1, sep_size-1))
+                return found;
+            begin = found + 1;
+        }
+
+        return NULL;
+    }
+
+    // 以sep为分隔符单遍解析source，对每个Token调用output(offset, length)：
+    // sep为空时整个source为一个Token；source为空时没有Token；
+    // sep出现在首尾时，首尾各有一个空Token；
+    // skip_sep为true时，连续出现的多个sep只算一个
+    template <class OutputType>
+    static int do_split(OutputType& output, const char* source, size_t source_size, const char* sep, size_t sep_size, bool skip_sep)
+    {
+        if (0 == sep_size)
+        {
+            output(0, source_size);
+            return 1;
+        }
+        if (0 == source_size)
         {
-            tokens->push_back(source);
+            return 0;
         }
-        else if (!source.empty())
+
+        int num_tokens = 0;
+        const char* end = source + source_size;
+        const char* begin = source; // 当前Token的开始
+        while (true)
         {
-            std::string str = source;
-            std::string::size_type pos = str.find(sep);
+            const char* found = find_sep(begin, end, sep, sep_size);
+            ++num_tokens;
+            if (NULL == found)
+            {
+                output(begin-source, end-begin);
+                break;
+            }
 
-            while (true)
+            output(begin-source, found-begin);
+            begin = found + sep_size;
+            if (skip_sep)
             {
-                std::string token = str.substr(0, pos);
-                tokens->push_back(token);
-
-                if (std::string::npos == pos)
-                {
-                    break;
-                }
-                if (skip_sep)
-                {
-                    bool end = false;
-                    while (0 == strncmp(sep.c_str(), &str[pos+1], sep.size()))
-                    {
-                        pos += sep.size();
-                        if (pos >= str.size())
-                        {
-                            end = true;
-                            tokens->push_back(std::string(""));
-                            break;
-                        }
-                    }
-
-                    if (end)
-                        break;
-                }
-
-                str = str.substr(pos + sep.size());
-                pos = str.find(sep);
+                while ((static_cast<size_t>(end-begin) >= sep_size) && (0 == memcmp(begin, sep, sep_size)))
+                    begin += sep_size;
             }
         }
 
-        return static_cast<int>(tokens->size());
+        return num_tokens;
     }
 };
 
@@ -92,7 +189,29 @@ public:
 class CEnhancedTokener
 {
 public:
+    typedef CFlatHashMap<std::string, std::string> TokenMap;
+
+public:
+    CEnhancedTokener()
+        : _sorted_map_valid(false)
+    {
+    }
+
+    /** 按name排序的结果，在每次parse后第一次调用时生成 */
     const std::map<std::string, std::string>& tokens() const
+    {
+        if (!_sorted_map_valid)
+        {
+            _sorted_map.clear();
+            for (TokenMap::const_iterator iter=_name_value_pair_map.begin(); iter!=_name_value_pair_map.end(); ++iter)
+                _sorted_map.insert(*iter);
+            _sorted_map_valid = true;
+        }
+        return _sorted_map;
+    }
+
+    /** 不排序的结果，没有tokens()的复制开销 */
+    const TokenMap& flat_tokens() const
     {
         return _name_value_pair_map;
     }
@@ -109,7 +228,7 @@ public:
     
     bool get(const std::string& name, std::string* value) const
     {
-        std::map<std::string, std::string>::const_iterator iter = _name_value_pair_map.find(name);
+        TokenMap::const_iterator iter = _name_value_pair_map.find(name);
         if (iter != _name_value_pair_map.end())
         {
             *value = iter->second;
@@ -131,35 +250,29 @@ public:
         std::vector<std::string> tokens;        
         int num_tokens = CTokener::split(&tokens, source, token_sep);
         
+        _sorted_map_valid = false;
+        _name_value_pair_map.reserve(_name_value_pair_map.size() + num_tokens);
         for (int i=0; i<num_tokens; ++i)
         {
             const std::string& token = tokens[i];
             std::string::size_type pos = token.find(name_value_sep);
             
-            std::string name;
-            std::string value;
             if (pos == std::string::npos)
             {
-                name = token;
+                // 用后面的覆盖前面的
+                _name_value_pair_map[token].clear();
             }
             else
             {
-                name = token.substr(0, pos);
-                value = token.substr(pos + 1);
-            }
-
-            std::pair<std::map<std::string, std::string>::iterator, bool> ret =
-                _name_value_pair_map.insert(std::make_pair(name, value));
-            if (!ret.second)
-            {
-                // 用后面的覆盖前面的
-                ret.first->second = value;
+                _name_value_pair_map[token.substr(0, pos)].assign(token, pos + 1, std::string::npos);
             }
         }
     }
     
 private:
-    std::map<std::string, std::string> _name_value_pair_map;
+    TokenMap _name_value_pair_map;
+    mutable bool _sorted_map_valid;
+    mutable std::map<std::string, std::string> _sorted_map;
 };
 
 /*
@@ -183,6 +296,166 @@ int main()
 }
 */
 
+#if __cplusplus >= 201703L
+/***
+  * 同CEnhancedTokener，但单遍解析且不复制：name和value为指向source的std::string_view，
+  * 按出现顺序存在内联的小数组中（不超过16个时不分配内存），查找时从后往前线性比较
+  * （先比较长度），重复的name以后面的值为准。查询串通常只有几个到十几个参数，
+  * 线性比较比建哈希表或树快得多，适合每个HTTP请求都要解析一次的查询串，如：
+  * CEnhancedTokenerView tokener;
+  * tokener.parse(request.get_query(), "&");
+  * std::string keyword;
+  * if (tokener.get_decoded("q", &keyword)) ...
+  *
+  * 1) 空的Token（如“a=1&&b=2”中的）被跳过，没有name_value_sep的Token的值为空
+  * 2) 值的URL解码（%XX和+）推迟到get_decoded时进行，只解码用到的值，name不解码
+  * 3) parse可多次调用，结果累加，clear后可重用
+  */
+class CEnhancedTokenerView
+{
+public:
+    typedef std::pair<std::string_view, std::string_view> Token;
+    typedef CSmallVector<Token, 16> TokenVector;
+
+public:
+    /** 按出现顺序的所有Token，包括重复的name */
+    const TokenVector& tokens() const
+    {
+        return _tokens;
+    }
+
+    size_t size() const
+    {
+        return _tokens.size();
+    }
+
+    /** 未经解码的值，不存在时返回空 */
+    std::string_view operator [](std::string_view name) const
+    {
+        const Token* token = find(name);
+        return (NULL == token)? std::string_view(): token->second;
+    }
+
+    bool exist(std::string_view name) const
+    {
+        return find(name) != NULL;
+    }
+
+    /** 得到未经解码的值 */
+    bool get(std::string_view name, std::string_view* value) const
+    {
+        const Token* token = find(name);
+        if (NULL == token)
+            return false;
+
+        *value = token->second;
+        return true;
+    }
+
+    /** 得到URL解码后的值，值中没有%和+时只复制 */
+    bool get_decoded(std::string_view name, std::string* value) const
+    {
+        const Token* token = find(name);
+        if (NULL == token)
+            return false;
+
+        const std::string_view& raw = token->second;
+        if (CStringSimd::find_first_of(raw.data(), raw.size(), '%', '+') == raw.size())
+        {
+            value->assign(raw.data(), raw.size());
+        }
+        else
+        {
+            value->resize(raw.size());
+            value->resize(CCodec::url_decode(raw.data(), raw.size(), &(*value)[0]));
+        }
+
+        return true;
+    }
+
+    std::string get_decoded(std::string_view name) const
+    {
+        std::string value;
+        (void)get_decoded(name, &value);
+        return value;
+    }
+
+    /***
+      * 解析source，source须在使用结果期间保持有效
+      * @return: 本次解析出的Token个数
+      */
+    int parse(std::string_view source, std::string_view token_sep, char name_value_sep='=')
+    {
+        ViewOutput output(&_tokens, source.data(), name_value_sep);
+        (void)CTokener::split_views(&output, source, token_sep);
+        return output.num_tokens;
+    }
+
+    int parse(const char* source, std::string_view token_sep, char name_value_sep='=')
+    {
+        return parse(std::string_view(source), token_sep, name_value_sep);
+    }
+
+    /** 同上，但source为临时对象时由CEnhancedTokenerView保管，直到clear */
+    int parse(std::string&& source, std::string_view token_sep, char name_value_sep='=')
+    {
+        _sources.push_back(std::string());
+        _sources.back().swap(source);
+        return parse(std::string_view(_sources.back()), token_sep, name_value_sep);
+    }
+
+    void clear()
+    {
+        _tokens.clear();
+        _sources.clear();
+    }
+
+private:
+    // split_views的容器，直接拆分name和value存入tokens
+    struct ViewOutput
+    {
+        TokenVector* tokens;
+        const char* source;
+        char name_value_sep;
+        int num_tokens;
+
+        ViewOutput(TokenVector* tokens_, const char* source_, char name_value_sep_)
+            : tokens(tokens_), source(source_), name_value_sep(name_value_sep_), num_tokens(0)
+        {
+        }
+
+        void push_back(std::string_view token)
+        {
+            if (token.empty())
+                return;
+
+            const std::string_view::size_type pos = token.find(name_value_sep);
+            if (std::string_view::npos == pos)
+                tokens->push_back(Token(token, std::string_view()));
+            else
+                tokens->push_back(Token(token.substr(0, pos), token.substr(pos+1)));
+            ++num_tokens;
+        }
+    };
+
+    const Token* find(std::string_view name) const
+    {
+        for (size_t i=_tokens.size(); i>0; --i)
+        {
+            const Token& token = _tokens[i-1];
+            if ((token.first.size() == name.size()) && (0 == memcmp(token.first.data(), name.data(), name.size())))
+                return &token;
+        }
+
+        return NULL;
+    }
+
+private:
+    TokenVector _tokens;
+    std::list<std::string> _sources; // 保管的临时source，list中的地址不变
+};
+#endif // __cplusplus >= 201703L
+
 // 解析如下形式的字符串（name可以相同，且不会互覆盖）：
 // name1=value2|name2=value3|name3=value3...
 class CEnhancedTokenerEx
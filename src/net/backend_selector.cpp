@@ -0,0 +1,287 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/backend_selector.h"
+#include "utils/exception.h"
+#include <algorithm>
+#include <errno.h>
+#include <math.h>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+// 还没有延迟样本的后端有在途请求时的延迟估计，使第一个应答回来之前不再涌入更多请求
+#define BACKEND_PENALTY_NANOSECONDS 1000000000.0
+
+struct AnyBackend
+{
+    bool operator ()(uint32_t) const { return true; }
+};
+
+CBackendSelector::CBackendSelector(uint32_t backend_number, const backend_policy_t& policy)
+    : _backend_number(backend_number), _policy(policy), _backends(NULL), _next_outlier_check(0)
+{
+    if (0 == backend_number)
+        THROW_EXCEPTION("backend number is 0", EINVAL);
+    if ((0 == policy.decay_milliseconds) || (0 == policy.failure_threshold) || (0 == policy.half_open_probes))
+        THROW_EXCEPTION("invalid backend policy", EINVAL);
+
+    _backends = new Backend[backend_number];
+    for (uint32_t i=0; i<backend_number; ++i)
+    {
+        Backend& backend = _backends[i];
+        backend.state = breaker_closed;
+        backend.outstanding = 0;
+        backend.probes = 0;
+        backend.consecutive_failures = 0;
+        backend.open_milliseconds = policy.open_milliseconds;
+        backend.open_until = 0;
+        backend.eject_until = 0;
+        backend.ewma = 0;
+        backend.last_sample = 0;
+        backend.selected_number = 0;
+    }
+}
+
+CBackendSelector::~CBackendSelector()
+{
+    delete []_backends;
+}
+
+int CBackendSelector::select()
+{
+    return select(AnyBackend());
+}
+
+void CBackendSelector::report(uint32_t index, bool success, uint64_t latency_nanoseconds)
+{
+    Backend& backend = _backends[index];
+    const uint64_t now = sys::CClock::get_nanoseconds();
+
+    {
+        sys::LockHelper<sys::CAdaptiveLock> lock_helper(backend.lock);
+        const uint32_t state = __atomic_load_n(&backend.state, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&backend.outstanding, __ATOMIC_RELAXED) > 0)
+            __atomic_sub_fetch(&backend.outstanding, 1, __ATOMIC_RELAXED);
+        if ((breaker_half_open == state) && (backend.probes > 0))
+            --backend.probes;
+
+        if (success)
+        {
+            // 升高时立即跟上，降低时按距上一个样本的时间平滑
+            const uint64_t ewma = __atomic_load_n(&backend.ewma, __ATOMIC_RELAXED);
+            uint64_t new_ewma = latency_nanoseconds;
+            if ((ewma > 0) && (latency_nanoseconds < ewma))
+            {
+                const double elapsed = static_cast<double>(now - backend.last_sample);
+                const double weight = exp(-elapsed / (_policy.decay_milliseconds * 1000000.0));
+                new_ewma = static_cast<uint64_t>(ewma * weight + latency_nanoseconds * (1.0 - weight));
+            }
+            __atomic_store_n(&backend.ewma, new_ewma, __ATOMIC_RELAXED);
+            __atomic_store_n(&backend.last_sample, now, __ATOMIC_RELAXED);
+            __atomic_store_n(&backend.consecutive_failures, 0, __ATOMIC_RELAXED);
+
+            // 熔断前发出的请求的成功不影响熔断，只有探测成功才恢复
+            if (breaker_half_open == state)
+            {
+                backend.open_milliseconds = _policy.open_milliseconds;
+                __atomic_store_n(&backend.state, breaker_closed, __ATOMIC_RELEASE);
+            }
+        }
+        else
+        {
+            const uint32_t failures = __atomic_add_fetch(&backend.consecutive_failures, 1, __ATOMIC_RELAXED);
+            if (breaker_half_open == state)
+            {
+                backend.open_milliseconds = std::min(backend.open_milliseconds * 2, _policy.max_open_milliseconds);
+                __atomic_store_n(&backend.open_until, now + backend.open_milliseconds * UINT64_C(1000000), __ATOMIC_RELAXED);
+                __atomic_store_n(&backend.state, breaker_open, __ATOMIC_RELEASE);
+            }
+            else if ((breaker_closed == state) && (failures >= _policy.failure_threshold))
+            {
+                backend.open_milliseconds = _policy.open_milliseconds;
+                __atomic_store_n(&backend.open_until, now + backend.open_milliseconds * UINT64_C(1000000), __ATOMIC_RELAXED);
+                __atomic_store_n(&backend.state, breaker_open, __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    // 只让一个线程做检查
+    if (_policy.outlier_interval_milliseconds > 0)
+    {
+        uint64_t next_check = __atomic_load_n(&_next_outlier_check, __ATOMIC_RELAXED);
+        if ((now >= next_check) &&
+            __atomic_compare_exchange_n(&_next_outlier_check, &next_check, now + _policy.outlier_interval_milliseconds * UINT64_C(1000000), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            check_outliers(now);
+        }
+    }
+}
+
+void CBackendSelector::cancel(uint32_t index)
+{
+    Backend& backend = _backends[index];
+    sys::LockHelper<sys::CAdaptiveLock> lock_helper(backend.lock);
+
+    if (__atomic_load_n(&backend.outstanding, __ATOMIC_RELAXED) > 0)
+        __atomic_sub_fetch(&backend.outstanding, 1, __ATOMIC_RELAXED);
+    if ((breaker_half_open == __atomic_load_n(&backend.state, __ATOMIC_RELAXED)) && (backend.probes > 0))
+        --backend.probes;
+}
+
+void CBackendSelector::get_stats(uint32_t index, backend_stats_t* stats) const
+{
+    const Backend& backend = _backends[index];
+    stats->state = static_cast<breaker_state_t>(__atomic_load_n(&backend.state, __ATOMIC_ACQUIRE));
+    stats->ejected = __atomic_load_n(&backend.eject_until, __ATOMIC_RELAXED) > sys::CClock::get_nanoseconds();
+    stats->outstanding = __atomic_load_n(&backend.outstanding, __ATOMIC_RELAXED);
+    stats->consecutive_failures = __atomic_load_n(&backend.consecutive_failures, __ATOMIC_RELAXED);
+    stats->ewma_nanoseconds = __atomic_load_n(&backend.ewma, __ATOMIC_RELAXED);
+    stats->selected_number = __atomic_load_n(&backend.selected_number, __ATOMIC_RELAXED);
+}
+
+// 不预留探测名额，预留在finish_select中进行
+bool CBackendSelector::is_available(uint32_t index, uint64_t now)
+{
+    Backend& backend = _backends[index];
+    if (__atomic_load_n(&backend.eject_until, __ATOMIC_RELAXED) > now)
+        return false;
+
+    uint32_t state = __atomic_load_n(&backend.state, __ATOMIC_ACQUIRE);
+    if (breaker_closed == state)
+        return true;
+    if ((breaker_open == state) && (__atomic_load_n(&backend.open_until, __ATOMIC_RELAXED) > now))
+        return false;
+
+    sys::LockHelper<sys::CAdaptiveLock> lock_helper(backend.lock);
+    state = __atomic_load_n(&backend.state, __ATOMIC_RELAXED);
+    if (breaker_open == state)
+    {
+        if (__atomic_load_n(&backend.open_until, __ATOMIC_RELAXED) > now)
+            return false;
+        backend.probes = 0;
+        __atomic_store_n(&backend.state, breaker_half_open, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    return (breaker_closed == state) || (backend.probes < _policy.half_open_probes);
+}
+
+// 没有在途请求时延迟估计随时间衰减，让长时间没被选中的慢后端可以得到一个请求来更新延迟，
+// 有在途请求时不衰减，避免在应答回来之前继续涌入
+double CBackendSelector::get_cost(const Backend& backend, uint64_t now) const
+{
+    const uint32_t outstanding = __atomic_load_n(&backend.outstanding, __ATOMIC_RELAXED);
+    double latency = static_cast<double>(__atomic_load_n(&backend.ewma, __ATOMIC_RELAXED));
+
+    if (0 == outstanding)
+    {
+        const uint64_t last_sample = __atomic_load_n(&backend.last_sample, __ATOMIC_RELAXED);
+        if (now > last_sample)
+            latency *= exp(-static_cast<double>(now - last_sample) / (_policy.decay_milliseconds * 1000000.0));
+        return latency;
+    }
+
+    if (0 == latency)
+        latency = BACKEND_PENALTY_NANOSECONDS;
+    return latency * (outstanding + 1);
+}
+
+int CBackendSelector::pick(uint32_t first, uint32_t second, uint64_t now)
+{
+    const uint32_t selected = (get_cost(_backends[first], now) <= get_cost(_backends[second], now))? first: second;
+    const uint32_t other = (selected == first)? second: first;
+
+    if (finish_select(selected))
+        return static_cast<int>(selected);
+    if ((other != selected) && finish_select(other))
+        return static_cast<int>(other);
+    return -1;
+}
+
+// 半开的后端在锁内预留探测名额，名额已被其它线程取走时失败
+bool CBackendSelector::finish_select(uint32_t index)
+{
+    Backend& backend = _backends[index];
+
+    if (breaker_closed != __atomic_load_n(&backend.state, __ATOMIC_ACQUIRE))
+    {
+        sys::LockHelper<sys::CAdaptiveLock> lock_helper(backend.lock);
+        const uint32_t state = __atomic_load_n(&backend.state, __ATOMIC_RELAXED);
+        if (breaker_open == state)
+            return false;
+        if (breaker_half_open == state)
+        {
+            if (backend.probes >= _policy.half_open_probes)
+                return false;
+            ++backend.probes;
+        }
+    }
+
+    __atomic_add_fetch(&backend.outstanding, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&backend.selected_number, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// 只用一个衰减时间常数内有样本的后端计算中位数，被剔除的后端到期时样本已旧，不会因旧样本被立即再次剔除
+void CBackendSelector::check_outliers(uint64_t now)
+{
+    const uint64_t window = _policy.decay_milliseconds * UINT64_C(1000000);
+    const uint32_t max_ejected = _backend_number * _policy.max_ejection_percent / 100;
+    std::vector<std::pair<uint64_t, uint32_t> > candidates; // (ewma, index)
+    uint32_t ejected = 0;
+
+    for (uint32_t i=0; i<_backend_number; ++i)
+    {
+        const Backend& backend = _backends[i];
+        if (__atomic_load_n(&backend.eject_until, __ATOMIC_RELAXED) > now)
+            ++ejected;
+        else if ((breaker_closed == __atomic_load_n(&backend.state, __ATOMIC_RELAXED)) &&
+                 (__atomic_load_n(&backend.last_sample, __ATOMIC_RELAXED) + window >= now))
+            candidates.push_back(std::make_pair(__atomic_load_n(&backend.ewma, __ATOMIC_RELAXED), i));
+    }
+    if ((candidates.size() < 3) || (ejected >= max_ejected))
+        return;
+
+    std::sort(candidates.begin(), candidates.end());
+    const double median = static_cast<double>(candidates[candidates.size() / 2].first);
+    for (size_t i=candidates.size(); (i > 0) && (ejected < max_ejected); --i)
+    {
+        const uint64_t ewma = candidates[i-1].first;
+        if ((ewma < _policy.outlier_min_nanoseconds) || (ewma <= median * _policy.outlier_factor))
+            break;
+
+        Backend& backend = _backends[candidates[i-1].second];
+        __atomic_store_n(&backend.eject_until, now + _policy.ejection_milliseconds * UINT64_C(1000000), __ATOMIC_RELAXED);
+        ++ejected;
+    }
+}
+
+uint32_t CBackendSelector::get_random()
+{
+    static __thread uint32_t seed = 0;
+    if (0 == seed)
+        seed = static_cast<uint32_t>(sys::CClock::get_nanoseconds()) | 1;
+
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+NET_NAMESPACE_END
@@ -0,0 +1,465 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/coroutine.h"
+#if MOOON_HAVE_COROUTINE
+#include "net/epollable.h"
+#include "sys/log.h"
+NET_NAMESPACE_BEGIN
+
+// spawn出的协程，自己运行到结束，结束时自动销毁
+class CDetachedTask
+{
+public:
+    struct promise_type
+    {
+        CDetachedTask get_return_object() { return CDetachedTask(); }
+        std::suspend_never initial_suspend() const noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() const noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static CDetachedTask run_detached(CTask<void> task)
+{
+    try
+    {
+        co_await task;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("coroutine error: %s\n", ex.str().c_str());
+    }
+    catch (std::exception& ex)
+    {
+        MYLOG_ERROR("coroutine exception: %s\n", ex.what());
+    }
+}
+
+class CSpawnTask: public ILoopTask
+{
+public:
+    CSpawnTask(CTask<void>&& task)
+        : _task(std::move(task))
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        (void)run_detached(std::move(_task));
+    }
+
+private:
+    CTask<void> _task;
+};
+
+void spawn(CEventLoop* event_loop, CTask<void>&& task)
+{
+    if (event_loop->in_loop_thread())
+        (void)run_detached(std::move(task));
+    else
+        event_loop->post(new CSpawnTask(std::move(task)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void CSleepAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    _handle = handle;
+    (void)_event_loop->run_after(_milliseconds, this);
+}
+
+uint32_t CSleepAwaiter::on_timer(CEventLoop* event_loop, uint64_t timer_id)
+{
+    // 恢复后本对象可能已随协程销毁，之后不能再访问成员
+    _handle.resume();
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CWhenAllItem make_when_all_item(CTask<void>& task, std::exception_ptr* exception)
+{
+    try
+    {
+        co_await task;
+    }
+    catch (...)
+    {
+        if (!*exception)
+            *exception = std::current_exception();
+    }
+}
+
+CTask<void> when_all(std::vector<CTask<void> > tasks)
+{
+    std::exception_ptr exception;
+    std::vector<CWhenAllItem> items;
+
+    items.reserve(tasks.size());
+    for (std::vector<CTask<void> >::size_type i=0; i<tasks.size(); ++i)
+        items.push_back(make_when_all_item(tasks[i], &exception));
+    co_await CWhenAllAwaiter(&items);
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CAsyncSocket的套接字，由CAsyncSocket和事件循环共同引用，
+// 在第一次需要等待时才加入事件循环，只监控有协程在等待的事件
+class CAsyncChannel: public CEpollable
+{
+public:
+    CAsyncChannel(CEventLoop* event_loop, int fd)
+        : _event_loop(event_loop), _registered(false), _reader(NULL), _writer(NULL)
+    {
+        set_fd(fd);
+    }
+
+    void attach(int fd)
+    {
+        set_fd(fd);
+    }
+
+    void wait(CAsyncSocket::CIoAwaiter* awaiter)
+    {
+        if (awaiter->is_read())
+            _reader = awaiter;
+        else
+            _writer = awaiter;
+        update_events();
+    }
+
+    // 取消等待，不恢复等待的协程
+    void cancel(CAsyncSocket::CIoAwaiter* awaiter)
+    {
+        if (_reader == awaiter)
+            _reader = NULL;
+        else if (_writer == awaiter)
+            _writer = NULL;
+        update_events();
+    }
+
+    // explicit为true时（调用者是另一个协程）挂起中的等待以ECANCELED结束，否则只取消
+    void shutdown(bool explicit_close)
+    {
+        CAsyncSocket::CIoAwaiter* reader = _reader;
+        CAsyncSocket::CIoAwaiter* writer = _writer;
+
+        _reader = NULL;
+        _writer = NULL;
+        if (_registered)
+        {
+            _registered = false;
+            _event_loop->remove(this, true);
+        }
+        else
+        {
+            close();
+        }
+
+        if (reader != NULL)
+        {
+            reader->cancel_timer();
+            if (explicit_close)
+                reader->complete(ECANCELED);
+        }
+        if (writer != NULL)
+        {
+            writer->cancel_timer();
+            if (explicit_close)
+                writer->complete(ECANCELED);
+        }
+    }
+
+private:
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+    {
+        // 在恢复的协程中本对象可能已被close，但事件循环仍引用着它，直到本轮事件处理完
+        CAsyncSocket::CIoAwaiter* reader = _reader;
+        if ((reader != NULL) && (events & (EPOLLIN|EPOLLERR|EPOLLHUP)))
+        {
+            _reader = NULL;
+            reader->on_ready();
+        }
+
+        CAsyncSocket::CIoAwaiter* writer = _writer;
+        if ((writer != NULL) && (events & (EPOLLOUT|EPOLLERR|EPOLLHUP)))
+        {
+            _writer = NULL;
+            writer->on_ready();
+        }
+
+        if (_registered)
+            update_events();
+        return epoll_none;
+    }
+
+    // 没有等待者时从事件循环中剔除，否则EPOLLERR和EPOLLHUP总是会被报告，导致空转
+    void update_events()
+    {
+        const int events = ((_reader != NULL)? EPOLLIN: 0) | ((_writer != NULL)? EPOLLOUT: 0);
+        if (0 == events)
+        {
+            if (_registered)
+            {
+                _registered = false;
+                _event_loop->remove(this, false);
+            }
+        }
+        else if (_registered)
+        {
+            _event_loop->modify(this, events);
+        }
+        else
+        {
+            _event_loop->add(this, events);
+            _registered = true;
+        }
+    }
+
+private:
+    CEventLoop* _event_loop;
+    bool _registered;
+    CAsyncSocket::CIoAwaiter* _reader;
+    CAsyncSocket::CIoAwaiter* _writer;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+CAsyncSocket::CIoAwaiter::CIoAwaiter(CAsyncSocket* socket, io_op_t op, void* buffer, size_t size, uint32_t milliseconds)
+    : _socket(socket), _op(op), _buffer(buffer), _size(size), _milliseconds(milliseconds)
+    , _timer_id(0), _done(false), _errcode(0), _result(0)
+{
+}
+
+bool CAsyncSocket::CIoAwaiter::await_ready()
+{
+    // connect在发起时已尝试过，需等待可写后才能取得结果
+    if (_done)
+        return true;
+    if (io_connect == _op)
+        return false;
+    return execute();
+}
+
+void CAsyncSocket::CIoAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    _handle = handle;
+    if (_milliseconds > 0)
+        _timer_id = _socket->_event_loop->run_after(_milliseconds, this);
+    _socket->_channel->wait(this);
+}
+
+ssize_t CAsyncSocket::CIoAwaiter::await_resume()
+{
+    if (_errcode != 0)
+    {
+        static const char* op_names[] = { "recv", "send", "accept", "connect" };
+        THROW_SYSCALL_EXCEPTION(NULL, _errcode, op_names[_op]);
+    }
+
+    return _result;
+}
+
+// 返回true表示已完成（成功或出错），false表示需要等待
+bool CAsyncSocket::CIoAwaiter::execute()
+{
+    const int fd = _socket->get_fd();
+    if (-1 == fd)
+    {
+        _errcode = EBADF;
+        _done = true;
+        return true;
+    }
+
+    for (;;)
+    {
+        ssize_t result;
+        if (io_receive == _op)
+        {
+            result = ::recv(fd, _buffer, _size, 0);
+        }
+        else if (io_send == _op)
+        {
+            result = ::send(fd, _buffer, _size, MSG_NOSIGNAL);
+        }
+        else if (io_accept == _op)
+        {
+            result = ::accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        }
+        else
+        {
+            int errcode = 0;
+            socklen_t errcode_length = sizeof(errcode);
+            if (-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &errcode_length))
+                errcode = errno;
+            errno = errcode;
+            result = (0 == errcode)? 0: -1;
+        }
+
+        if (result >= 0)
+        {
+            _result = result;
+        }
+        else if (EINTR == errno)
+        {
+            continue;
+        }
+        else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            return false;
+        }
+        else
+        {
+            _errcode = errno;
+        }
+
+        _done = true;
+        return true;
+    }
+}
+
+// 以errcode结束等待并恢复协程
+void CAsyncSocket::CIoAwaiter::complete(int errcode)
+{
+    _errcode = errcode;
+    _done = true;
+    _handle.resume();
+}
+
+void CAsyncSocket::CIoAwaiter::cancel_timer()
+{
+    if (_timer_id != 0)
+    {
+        (void)_socket->_event_loop->cancel_timer(_timer_id);
+        _timer_id = 0;
+    }
+}
+
+// 就绪时再尝试，可能被其它线程或进程抢先（如多个进程accept同一监听套接字），这时继续等待
+void CAsyncSocket::CIoAwaiter::on_ready()
+{
+    if (!execute())
+    {
+        _socket->_channel->wait(this);
+        return;
+    }
+
+    cancel_timer();
+    _handle.resume();
+}
+
+uint32_t CAsyncSocket::CIoAwaiter::on_timer(CEventLoop* event_loop, uint64_t timer_id)
+{
+    _timer_id = 0;
+    _socket->_channel->cancel(this);
+    complete(ETIMEDOUT);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CAsyncSocket::CAsyncSocket(CEventLoop* event_loop, int fd)
+    : _event_loop(event_loop)
+{
+    if (fd != -1)
+        net::set_nonblock(fd, true);
+    _channel = new CAsyncChannel(event_loop, fd);
+    _channel->inc_refcount();
+}
+
+CAsyncSocket::~CAsyncSocket()
+{
+    _channel->shutdown(false);
+    _channel->dec_refcount();
+}
+
+int CAsyncSocket::get_fd() const
+{
+    return _channel->get_fd();
+}
+
+void CAsyncSocket::close()
+{
+    _channel->shutdown(true);
+}
+
+CAsyncSocket::CIoAwaiter CAsyncSocket::connect(const ip_node_t& peer, uint32_t milliseconds)
+{
+    CIoAwaiter awaiter(this, io_connect, NULL, 0, milliseconds);
+    struct sockaddr_storage peer_addr;
+    socklen_t addr_length;
+    const uint32_t* ip_data = peer.ip.get_address_data();
+
+    memset(&peer_addr, 0, sizeof(peer_addr));
+    if (peer.ip.is_ipv6())
+    {
+        struct sockaddr_in6* peer_addr_in6 = reinterpret_cast<struct sockaddr_in6*>(&peer_addr);
+        addr_length = sizeof(struct sockaddr_in6);
+        peer_addr_in6->sin6_family = AF_INET6;
+        peer_addr_in6->sin6_port = htons(peer.port);
+        memcpy(&peer_addr_in6->sin6_addr, ip_data, sizeof(peer_addr_in6->sin6_addr));
+    }
+    else
+    {
+        struct sockaddr_in* peer_addr_in = reinterpret_cast<struct sockaddr_in*>(&peer_addr);
+        addr_length = sizeof(struct sockaddr_in);
+        peer_addr_in->sin_family = AF_INET;
+        peer_addr_in->sin_port = htons(peer.port);
+        peer_addr_in->sin_addr.s_addr = ip_data[0];
+    }
+
+    if (-1 == get_fd())
+    {
+        const int fd = socket(peer_addr.ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        if (-1 == fd)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "socket");
+        _channel->attach(fd);
+    }
+
+    // 本地连接通常立即成功，这时不需要挂起
+    if (0 == ::connect(get_fd(), reinterpret_cast<struct sockaddr*>(&peer_addr), addr_length))
+        awaiter._done = true;
+    else if (errno != EINPROGRESS)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "connect");
+    return awaiter;
+}
+
+CTask<bool> CAsyncSocket::full_receive(char* buffer, size_t buffer_size, uint32_t milliseconds)
+{
+    for (size_t offset=0; offset<buffer_size;)
+    {
+        const ssize_t bytes = co_await receive(buffer+offset, buffer_size-offset, milliseconds);
+        if (0 == bytes)
+            co_return false;
+        offset += static_cast<size_t>(bytes);
+    }
+
+    co_return true;
+}
+
+CTask<void> CAsyncSocket::full_send(const char* buffer, size_t buffer_size, uint32_t milliseconds)
+{
+    for (size_t offset=0; offset<buffer_size;)
+    {
+        const ssize_t bytes = co_await send(buffer+offset, buffer_size-offset, milliseconds);
+        offset += static_cast<size_t>(bytes);
+    }
+}
+
+NET_NAMESPACE_END
+#endif // MOOON_HAVE_COROUTINE
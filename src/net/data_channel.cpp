@@ -17,9 +17,14 @@
  * Author: jian yi, eyjian@qq.com
  */
 #include "data_channel.h"
+#include <mooon/net/io_buffer.h>
+#include <mooon/net/io_uring.h>
 #include <mooon/sys/atomic.h>
 #include <mooon/sys/utils.h>
 #include <mooon/net/utils.h>
+#include <mooon/sys/close_helper.h>
+#include <algorithm>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/sendfile.h>
@@ -60,6 +65,7 @@ long get_recv_buffer_bytes()
 //////////////////////////////////////////////////////////////////////////
 CDataChannel::CDataChannel()
     :_fd(-1)
+    ,_io_uring(false)
 {
 }
 
@@ -68,6 +74,115 @@ void CDataChannel::attach(int fd)
     _fd = fd;
 }
 
+bool CDataChannel::enable_io_uring(bool enable)
+{
+    _io_uring = enable && CIoUring::is_supported();
+    return _io_uring == enable;
+}
+
+// 线程的io_uring创建失败（如锁定内存超限）时返回NULL，改用普通的系统调用
+CIoUring* CDataChannel::get_ring() const
+{
+    return _io_uring? CIoUring::get_thread_ring(): NULL;
+}
+
+// io_uring操作返回负的错误码，和普通系统调用一样，非阻塞时的EAGAIN不当作错误
+void CDataChannel::throw_uring_error(int res, const char* call)
+{
+    errno = -res;
+    if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        return;
+
+    THROW_SYSCALL_EXCEPTION(NULL, -res, call);
+}
+
+// 每次以剩余的时间作为链接的超时，返回已收或发的字节数，
+// 非阻塞连接不能再收发时errno为EAGAIN，由调用者改用poll等待
+ssize_t CDataChannel::uring_timed_transfer(bool is_receive, char* buffer, size_t buffer_size, const sys::CDeadline& deadline, bool* closed)
+{
+    CIoUring* ring = get_ring();
+    size_t buffer_offset = 0;
+
+    errno = 0;
+    while (buffer_offset < buffer_size)
+    {
+        const int remaining = deadline.get_remaining_milliseconds();
+        if (0 == remaining)
+            break;
+
+        // 无限期时不设链接的超时
+        const uint32_t timeout = (remaining < 0)? 0: static_cast<uint32_t>(remaining);
+        int res = is_receive
+                ? ring->recv(_fd, buffer+buffer_offset, buffer_size-buffer_offset, MSG_WAITALL, timeout)
+                : ring->send(_fd, buffer+buffer_offset, buffer_size-buffer_offset, MSG_WAITALL, timeout);
+        if (res > 0)
+        {
+            buffer_offset += res;
+            atomic_add(res, is_receive? &gs_recv_buffer_bytes: &gs_send_buffer_bytes);
+            continue;
+        }
+        if (0 == res)
+        {
+            if (is_receive)
+                *closed = true;
+            break;
+        }
+        if (-ETIMEDOUT == res)
+            break;
+
+        throw_uring_error(res, is_receive? "recv": "send");
+        break;
+    }
+
+    return buffer_offset;
+}
+
+// poll以剩余的时间等待，收发时带MSG_DONTWAIT，
+// 阻塞的连接也不会在一次send中等待发送缓冲区而超过截止时间
+ssize_t CDataChannel::deadline_transfer(bool is_receive, char* buffer, size_t buffer_size, const sys::CDeadline& deadline, bool* closed)
+{
+    size_t buffer_offset = 0;
+
+    *closed = false;
+    if (get_ring() != NULL)
+    {
+        buffer_offset = uring_timed_transfer(is_receive, buffer, buffer_size, deadline, closed);
+        if ((buffer_offset == buffer_size) || *closed || (errno != EAGAIN))
+            return buffer_offset;
+    }
+
+    while (buffer_offset < buffer_size)
+    {
+        const int remaining = deadline.get_remaining_milliseconds();
+        if (0 == remaining)
+            break;
+        if (!CUtils::timed_poll(_fd, is_receive? POLLIN: POLLOUT, remaining))
+            break;
+
+        ssize_t retval = is_receive
+                       ? ::recv(_fd, buffer+buffer_offset, buffer_size-buffer_offset, MSG_DONTWAIT)
+                       : ::send(_fd, buffer+buffer_offset, buffer_size-buffer_offset, MSG_DONTWAIT);
+        if (retval > 0)
+        {
+            buffer_offset += retval;
+            atomic_add(retval, is_receive? &gs_recv_buffer_bytes: &gs_send_buffer_bytes);
+            continue;
+        }
+        if (0 == retval)
+        {
+            // 对端关闭了连接，send不会返回0
+            *closed = true;
+            break;
+        }
+        if ((EWOULDBLOCK == errno) || (EAGAIN == errno) || (EINTR == errno))
+            continue;
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, is_receive? "recv": "send");
+    }
+
+    return buffer_offset;
+}
+
 ssize_t CDataChannel::receive(char* buffer, size_t buffer_size)
 {
     ssize_t retval;
@@ -76,6 +191,19 @@ ssize_t CDataChannel::receive(char* buffer, size_t buffer_size)
     {
         THROW_SYSCALL_EXCEPTION(NULL, EINVAL, NULL);
     }
+    CIoUring* ring = get_ring();
+    if (ring != NULL)
+    {
+        retval = ring->recv(_fd, buffer, buffer_size, 0);
+        if (retval < 0)
+        {
+            throw_uring_error(static_cast<int>(retval), "recv");
+            return -1;
+        }
+
+        atomic_add(retval, &gs_recv_buffer_bytes);
+        return retval;
+    }
     for (;;)
     {
         retval = ::recv(_fd, buffer, buffer_size, 0);
@@ -100,6 +228,19 @@ ssize_t CDataChannel::send(const char* buffer, size_t buffer_size)
     {
         THROW_SYSCALL_EXCEPTION(NULL, EINVAL, NULL);
     }
+    CIoUring* ring = get_ring();
+    if (ring != NULL)
+    {
+        retval = ring->send(_fd, buffer, buffer_size, 0);
+        if (retval < 0)
+        {
+            throw_uring_error(static_cast<int>(retval), "send");
+            return -1;
+        }
+
+        atomic_add(retval, &gs_send_buffer_bytes);
+        return retval;
+    }
     for (;;)
     {
         retval = ::send(_fd, buffer, buffer_size, 0);
@@ -117,66 +258,77 @@ ssize_t CDataChannel::send(const char* buffer, size_t buffer_size)
 
 ssize_t CDataChannel::timed_receive(char* buffer, size_t buffer_size, uint32_t milliseconds)
 {
-    size_t buffer_offset = 0;
+    // 整个接收共用一个超时，而不是每次poll一个
+    return timed_receive(buffer, buffer_size, sys::CDeadline(milliseconds));
+}
 
-    for (;;)
-    {
-        if (!CUtils::timed_poll(_fd, POLLIN, milliseconds))
-        {
-            break;
-        }
+ssize_t CDataChannel::timed_send(const char* buffer, size_t buffer_size, uint32_t milliseconds)
+{
+    return timed_send(buffer, buffer_size, sys::CDeadline(milliseconds));
+}
 
-        ssize_t retval = receive(buffer+buffer_offset, buffer_size-buffer_offset);
-        if (0 == retval)
-        {
-            break;
-        }
-        if (retval > 0)
-        {
-            buffer_offset += retval;
-            if (buffer_offset == buffer_size)
-            {
-                break;
-            }
-        }
-    }
+ssize_t CDataChannel::timed_receive(char* buffer, size_t buffer_size, const sys::CDeadline& deadline)
+{
+    bool closed;
+    return deadline_transfer(true, buffer, buffer_size, deadline, &closed);
+}
 
-    return buffer_offset;
+ssize_t CDataChannel::timed_send(const char* buffer, size_t buffer_size, const sys::CDeadline& deadline)
+{
+    bool closed;
+    return deadline_transfer(false, const_cast<char*>(buffer), buffer_size, deadline, &closed);
 }
 
-ssize_t CDataChannel::timed_send(const char* buffer, size_t buffer_size, uint32_t milliseconds)
+bool CDataChannel::full_receive(char* buffer, size_t& buffer_size, const sys::CDeadline& deadline)
 {
-    size_t buffer_offset = 0;
-    
-    for (;;)
-    {
-        if (!CUtils::timed_poll(_fd, POLLOUT, milliseconds))
-        {
-            break;
-        }
+    bool closed;
+    const size_t size = buffer_size;
 
-        ssize_t retval = send(buffer+buffer_offset, buffer_size-buffer_offset);
-        if (retval > 0)
-        {
-            buffer_offset += retval;
-            if (buffer_offset == buffer_size)
-            {
-                break;
-            }
-        }
-    }
+    buffer_size = deadline_transfer(true, buffer, size, deadline, &closed);
+    if (buffer_size == size)
+        return true;
+    if (closed)
+        return false;
 
-    return buffer_offset;
+    THROW_SYSCALL_EXCEPTION(NULL, ETIMEDOUT, "recv");
+}
+
+void CDataChannel::full_send(const char* buffer, size_t& buffer_size, const sys::CDeadline& deadline)
+{
+    bool closed;
+    const size_t size = buffer_size;
+
+    buffer_size = deadline_transfer(false, const_cast<char*>(buffer), size, deadline, &closed);
+    if (buffer_size != size)
+        THROW_SYSCALL_EXCEPTION(NULL, ETIMEDOUT, "send");
 }
 
 bool CDataChannel::full_receive(char* buffer, size_t& buffer_size)
-{    
+{
+    // 在CDeadlineScope中时受限于本线程当前的截止时间
+    const sys::CDeadline deadline = sys::CDeadline::get_current();
+    if (!deadline.is_infinite())
+        return full_receive(buffer, buffer_size, deadline);
+
     char* buffer_offset = buffer;
     size_t remaining_size = buffer_size;
 
     while (remaining_size > 0)
     {
-        ssize_t retval = CDataChannel::receive(buffer_offset, remaining_size);
+        ssize_t retval;
+        CIoUring* ring = get_ring();
+        if (ring != NULL)
+        {
+            // MSG_WAITALL：收满才完成，通常一次提交即可
+            retval = ring->recv(_fd, buffer_offset, remaining_size, MSG_WAITALL);
+            if (retval < 0)
+                THROW_SYSCALL_EXCEPTION(NULL, static_cast<int>(-retval), "recv");
+            atomic_add(retval, &gs_recv_buffer_bytes);
+        }
+        else
+        {
+            retval = CDataChannel::receive(buffer_offset, remaining_size);
+        }
         if (0 == retval)
         {
             buffer_size = buffer_size - remaining_size;
@@ -192,13 +344,35 @@ bool CDataChannel::full_receive(char* buffer, size_t& buffer_size)
 }
 
 void CDataChannel::full_send(const char* buffer, size_t& buffer_size)
-{    
+{
+    const sys::CDeadline deadline = sys::CDeadline::get_current();
+    if (!deadline.is_infinite())
+    {
+        full_send(buffer, buffer_size, deadline);
+        return;
+    }
+
     const char* buffer_offset = buffer;
     size_t remaining_size = buffer_size;
 
     while (remaining_size > 0)
     {
-        ssize_t retval = CDataChannel::send(buffer_offset, remaining_size);
+        ssize_t retval;
+        CIoUring* ring = get_ring();
+        if (ring != NULL)
+        {
+            retval = ring->send(_fd, buffer_offset, remaining_size, MSG_WAITALL);
+            if (retval < 0)
+            {
+                buffer_size = buffer_size - remaining_size;
+                THROW_SYSCALL_EXCEPTION(NULL, static_cast<int>(-retval), "send");
+            }
+            atomic_add(retval, &gs_send_buffer_bytes);
+        }
+        else
+        {
+            retval = CDataChannel::send(buffer_offset, remaining_size);
+        }
 
         buffer_offset += retval;
         remaining_size -= retval;        
@@ -237,13 +411,34 @@ void CDataChannel::full_send_file(int file_fd, off_t *offset, size_t& count)
             THROW_SYSCALL_EXCEPTION(NULL, errno, "send");
         }
 
-        offset += retval;
+        // sendfile已经更新了offset
         remaining_size -= retval;        
     }
 
     count = count - remaining_size;
 }
 
+utils::handle_result_t CDataChannel::continue_send_file(int file_fd, off_t* offset, size_t& count, size_t chunk_size, uint32_t chunk_number)
+{
+    if (0 == chunk_size)
+        chunk_size = count;
+
+    for (uint32_t i=0; (count > 0) && ((0 == chunk_number) || (i < chunk_number)); ++i)
+    {
+        ssize_t retval = CDataChannel::send_file(file_fd, offset, std::min(count, chunk_size));
+        if (-1 == retval)
+            break; // 发送缓冲区已满，等待可写事件
+        if (0 == retval) // 文件比调用者给的短，不能再发送了
+            THROW_SYSCALL_EXCEPTION(NULL, EIO, "sendfile");
+
+        count -= retval;
+    }
+
+    return (0 == count)
+         ? utils::handle_finish
+         : utils::handle_continue;
+}
+
 bool CDataChannel::full_map_tofile(int file_fd, size_t& size, size_t offset)
 {
     sys::mmap_t* ptr;
@@ -284,16 +479,10 @@ bool CDataChannel::full_write_tofile(int file_fd, size_t& size, size_t offset)
      
     for (;;)
     {
-        ssize_t retval = CDataChannel::receive(buffer, remaining_size);
-        if (0 == retval) 
+        ssize_t retval = CDataChannel::receive(buffer, std::min(remaining_size, static_cast<size_t>(sys::CUtils::get_page_size())));
+        if ((0 == retval) || (-1 == retval))
         {
-            // 连接被对端关闭
-            size = size - remaining_size;
-            THROW_SYSCALL_EXCEPTION(NULL, -1, "recv");
-        }
-        else if (-1 == retval)
-        {
-            // 连接异常
+            // 连接被对端关闭，或非阻塞连接暂无数据
             size = size - remaining_size;
             return false;
         }
@@ -318,10 +507,117 @@ bool CDataChannel::full_write_tofile(int file_fd, size_t& size, size_t offset)
     return true;
 }
 
+// 管道的大小，即每次splice最多移动的字节数
+#define SPLICE_PIPE_SIZE (1024*1024)
+
+// 将管道中的bytes个字节移到文件，文件不支持splice时改为经用户空间缓冲写入
+static ssize_t pipe_to_file(int pipe_fd, int file_fd, loff_t* file_offset, size_t bytes, bool* use_splice)
+{
+    if (*use_splice)
+    {
+        ssize_t written = splice(pipe_fd, NULL, file_fd, file_offset, bytes, SPLICE_F_MOVE);
+        if ((written != -1) || (errno != EINVAL))
+            return written;
+
+        *use_splice = false;
+    }
+
+    char buffer[8192];
+    ssize_t bytes_read = read(pipe_fd, buffer, std::min(bytes, sizeof(buffer)));
+    if (bytes_read <= 0)
+        return -1;
+
+    ssize_t written = pwrite(file_fd, buffer, bytes_read, *file_offset);
+    if (written != bytes_read)
+    {
+        // 已从管道中读出的数据不能再放回，部分写入也只能当作失败
+        if (written != -1)
+            errno = EIO;
+        return -1;
+    }
+
+    *file_offset += written;
+    return written;
+}
+
+bool CDataChannel::full_splice_tofile(int file_fd, size_t& size, size_t offset)
+{
+    int pipe_fds[2];
+    if (-1 == pipe2(pipe_fds, O_CLOEXEC))
+    {
+        size = 0;
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "pipe2");
+    }
+
+    sys::CloseHelper<int> read_end(pipe_fds[0]);
+    sys::CloseHelper<int> write_end(pipe_fds[1]);
+    // 加大管道以减少splice次数，超过/proc/sys/fs/pipe-max-size时保持原大小
+    int pipe_size = fcntl(pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    if (-1 == pipe_size)
+        pipe_size = fcntl(pipe_fds[1], F_GETPIPE_SZ);
+    if (pipe_size <= 0)
+        pipe_size = 65536;
+
+    bool use_splice = true;
+    loff_t file_offset = offset;
+    size_t remaining_size = size;
+
+    while (remaining_size > 0)
+    {
+        ssize_t retval = splice(_fd, NULL, pipe_fds[1], NULL, std::min(remaining_size, static_cast<size_t>(pipe_size)), SPLICE_F_MOVE|SPLICE_F_MORE);
+        if (0 == retval)
+        {
+            // 连接被对端关闭
+            size = size - remaining_size;
+            return false;
+        }
+        if (-1 == retval)
+        {
+            if (EINTR == errno)
+                continue;
+
+            size = size - remaining_size;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "splice");
+        }
+
+        atomic_add(retval, &gs_recv_buffer_bytes);
+        while (retval > 0)
+        {
+            ssize_t written = pipe_to_file(pipe_fds[0], file_fd, &file_offset, retval, &use_splice);
+            if (-1 == written)
+            {
+                if (EINTR == errno)
+                    continue;
+
+                size = size - remaining_size;
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "splice");
+            }
+
+            retval -= written;
+            remaining_size -= written;
+        }
+    }
+
+    return true;
+}
+
 ssize_t CDataChannel::readv(const struct iovec *iov, int iovcnt)
 {
     ssize_t retval;
-    
+
+    CIoUring* ring = get_ring();
+    if (ring != NULL)
+    {
+        retval = ring->readv(_fd, iov, iovcnt);
+        if (retval < 0)
+        {
+            throw_uring_error(static_cast<int>(retval), "readv");
+            return -1;
+        }
+
+        atomic_add(retval, &gs_recv_buffer_bytes);
+        return retval;
+    }
     for (;;)
     {
         retval = ::readv(_fd, iov, iovcnt);
@@ -340,7 +636,20 @@ ssize_t CDataChannel::readv(const struct iovec *iov, int iovcnt)
 ssize_t CDataChannel::writev(const struct iovec *iov, int iovcnt)
 {
     ssize_t retval;
-    
+
+    CIoUring* ring = get_ring();
+    if (ring != NULL)
+    {
+        retval = ring->writev(_fd, iov, iovcnt);
+        if (retval < 0)
+        {
+            throw_uring_error(static_cast<int>(retval), "writev");
+            return -1;
+        }
+
+        atomic_add(retval, &gs_send_buffer_bytes);
+        return retval;
+    }
     for (;;)
     {
         retval = ::writev(_fd, iov, iovcnt);
@@ -356,4 +665,14 @@ ssize_t CDataChannel::writev(const struct iovec *iov, int iovcnt)
     return retval;
 }
 
+ssize_t CDataChannel::receive(CIoBuffer* buffer)
+{
+    return buffer->read_from(this);
+}
+
+ssize_t CDataChannel::send(CIoBuffer* buffer)
+{
+    return buffer->write_to(this);
+}
+
 NET_NAMESPACE_END
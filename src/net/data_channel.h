@@ -22,15 +22,28 @@
 #ifndef MOOON_NET_DATA_CHANNEL_H
 #define MOOON_NET_DATA_CHANNEL_H
 #include "mooon/net/config.h"
+#include "mooon/sys/deadline.h"
 #include "mooon/sys/syscall_exception.h"
 #include <sys/uio.h>
 NET_NAMESPACE_BEGIN
 
+class CIoBuffer;
+class CIoUring;
+
 class CDataChannel
 {
 public:
     CDataChannel();
     void attach(int fd);
+
+    /***
+      * 是否使用io_uring收发，使用调用线程的CIoUring实例，
+      * 超时收发以链接的超时代替poll，完整收发以MSG_WAITALL一次提交，
+      * 只影响receive、send、timed_receive、timed_send、full_receive、full_send、readv和writev
+      * @return: 如果内核不支持io_uring，则返回false，仍使用普通的系统调用
+      */
+    bool enable_io_uring(bool enable);
+    bool is_io_uring_enabled() const { return _io_uring; }
     
     /** 接收SOCKET数据
       * @buffer: 接收缓冲区
@@ -51,7 +64,8 @@ public:
     ssize_t send(const char* buffer, size_t buffer_size);
 
     /***
-      * 以超时方式接收数据，如果在指定的时间内未接收完，则返回
+      * 以超时方式接收数据，如果在指定的时间内未接收完，则返回，
+      * 超时是整个接收的，不是每次poll的，中间收到部分数据不会延长超时
       * @milliseconds: 超时毫秒数
       * @return 返回实际已经接收的字节数，如果小于buffer_size，则表示接收超时
       * @exception: 如果发生网络错误，则抛出CSyscallException异常
@@ -66,23 +80,47 @@ public:
       */
     ssize_t timed_send(const char* buffer, size_t buffer_size, uint32_t milliseconds);
 
+    /***
+      * 同上，但以截止时间代替超时，多次调用可共用一个截止时间，
+      * 如一个请求的发送和接收合起来不超过指定的时长
+      */
+    ssize_t timed_receive(char* buffer, size_t buffer_size, const sys::CDeadline& deadline);
+    ssize_t timed_send(const char* buffer, size_t buffer_size, const sys::CDeadline& deadline);
+
     /** 完整接收，如果成功返回，则一定接收了指定字节数的数据
       * @buffer: 接收缓冲区
       * @buffer_size: 接收缓冲区字节大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
       * @return: 如果成功，则返回true，否则如果连接被对端关闭则返回false
       * @exception: 如果发生网络错误，则抛出CSyscallException；对于非阻塞连接，也可能抛出CSyscallException异常
+      * @注意事项：在CDeadlineScope中调用时，同带截止时间的full_receive，以本线程当前的截止时间
       */
     bool full_receive(char* buffer, size_t& buffer_size);
 
+    /***
+      * 在截止时间之前完整接收，阻塞和非阻塞的连接均可
+      * @buffer_size: 返回实际已经接收到的字节数(不管成功还是失败或异常)
+      * @return: 如果成功，则返回true，否则如果连接被对端关闭则返回false
+      * @exception: 到了截止时间还未收完，抛出错误码为ETIMEDOUT的CSyscallException异常
+      */
+    bool full_receive(char* buffer, size_t& buffer_size, const sys::CDeadline& deadline);
+
     /** 完整发送，如果成功返回，则总是发送了指定字节数的数据
       * @buffer: 发送缓冲区
       * @buffer_size: 需要发送的字节数，返回实际已经发送了的字节数(不管成功还是失败或异常)
       * @return: 无返回值
       * @exception: 如果网络错误，则抛出CSyscallException异常；对于非阻塞连接，也可能抛出CSyscallException异常
-      * @注意事项：保证不发送0字节的数据，也就是buffer_size必须大于0
+      * @注意事项：保证不发送0字节的数据，也就是buffer_size必须大于0；
+      *           在CDeadlineScope中调用时，同带截止时间的full_send，以本线程当前的截止时间
       */
     void full_send(const char* buffer, size_t& buffer_size);
 
+    /***
+      * 在截止时间之前完整发送，阻塞和非阻塞的连接均可
+      * @buffer_size: 返回实际已经发送了的字节数(不管成功还是失败或异常)
+      * @exception: 到了截止时间还未发完，抛出错误码为ETIMEDOUT的CSyscallException异常
+      */
+    void full_send(const char* buffer, size_t& buffer_size, const sys::CDeadline& deadline);
+
     /** 发送文件，调用者必须保证offset+count不超过文件大小
       * @file_fd: 打开的文件句柄
       * @offset: 文件偏移位置，如果成功则返回新的偏移位置
@@ -91,6 +129,18 @@ public:
     ssize_t send_file(int file_fd, off_t *offset, size_t count);
     void full_send_file(int file_fd, off_t *offset, size_t& count);
 
+    /***
+      * 分块发送文件，用于在事件循环中发送大文件：每次sendfile最多chunk_size字节，
+      * 最多chunk_number次后即返回，不会因一个大文件长时间占住事件循环线程，
+      * 非阻塞连接的发送缓冲区满时也返回，之后等可写事件到达再调用
+      * @offset: 文件偏移位置，返回新的偏移位置
+      * @count: 还需要发送的字节数，返回还剩余的字节数
+      * @chunk_number: 为0表示不限次数，直到发送完或发送缓冲区满
+      * @return: 发送完返回utils::handle_finish，否则返回utils::handle_continue
+      * @exception: 如果发生网络错误，则抛出CSyscallException异常
+      */
+    utils::handle_result_t continue_send_file(int file_fd, off_t* offset, size_t& count, size_t chunk_size, uint32_t chunk_number);
+
     /** 采用内存映射的方式接收，并将数据存放文件，适合文件不是太大
       * @file_fd: 打开的文件句柄
       * @size: 需要写入文件的大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
@@ -108,12 +158,32 @@ public:
       * @exception: 如果发生系统调用错误，则抛出CSyscallException异常
       */
     bool full_write_tofile(int file_fd, size_t& size, size_t offset);
+
+    /***
+      * 采用splice的方式接收，并将数据存放文件，数据经管道在内核中从连接移到文件，不经过用户空间，
+      * 适合任意大小的文件，如果文件不支持splice，则经用户空间的缓冲写入，参数和返回值同full_write_tofile
+      */
+    bool full_splice_tofile(int file_fd, size_t& size, size_t offset);
     
     ssize_t readv(const struct iovec *iov, int iovcnt);
     ssize_t writev(const struct iovec *iov, int iovcnt);
 
+    /***
+      * 以readv直接收到buffer的块中，以writev直接发送buffer的各片段，
+      * 返回值同readv和writev，已发送的从buffer中丢弃
+      */
+    ssize_t receive(CIoBuffer* buffer);
+    ssize_t send(CIoBuffer* buffer);
+
+private:
+    CIoUring* get_ring() const;
+    ssize_t uring_timed_transfer(bool is_receive, char* buffer, size_t buffer_size, const sys::CDeadline& deadline, bool* closed);
+    ssize_t deadline_transfer(bool is_receive, char* buffer, size_t buffer_size, const sys::CDeadline& deadline, bool* closed);
+    void throw_uring_error(int res, const char* call);
+
 private:
     int _fd;
+    bool _io_uring;
 };
 
 NET_NAMESPACE_END
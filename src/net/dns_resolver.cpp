@@ -0,0 +1,445 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/dns_resolver.h"
+#include "net/event_loop.h"
+#include "net/utils.h"
+#include "sys/log.h"
+#include <netdb.h>
+#include <string.h>
+NET_NAMESPACE_BEGIN
+
+// 在事件循环中回调IResolveHandler
+class CResolveTask: public ILoopTask
+{
+public:
+    CResolveTask(IResolveHandler* handler, const std::string& hostname, const ip_address_array_t& ip_array, const std::string& errinfo)
+        : _handler(handler), _hostname(hostname), _ip_array(ip_array), _errinfo(errinfo)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _handler->on_resolved(_hostname, _ip_array, _errinfo);
+    }
+
+private:
+    IResolveHandler* _handler;
+    std::string _hostname;
+    ip_address_array_t _ip_array;
+    std::string _errinfo;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+CDnsResolver::CDnsResolver(uint32_t positive_ttl, uint32_t negative_ttl, uint32_t stale_ttl, double prefetch_ratio, bool prefer_ipv6)
+    : _positive_ttl(positive_ttl), _negative_ttl(negative_ttl), _stale_ttl(stale_ttl)
+    , _prefetch_ratio(prefetch_ratio), _prefer_ipv6(prefer_ipv6), _stop(false)
+    , _hit_number(0), _miss_number(0), _prefetch_number(0), _stale_number(0), _lookup_number(0)
+{
+}
+
+CDnsResolver::~CDnsResolver()
+{
+    destroy();
+}
+
+void CDnsResolver::create(uint16_t thread_number)
+{
+    _stop = false;
+    for (uint16_t i=0; i<thread_number; ++i)
+        _threads.push_back(new sys::CThreadEngine(sys::bind(&CDnsResolver::run, this)));
+}
+
+void CDnsResolver::destroy()
+{
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        _stop = true;
+        _request_event.broadcast();
+    }
+
+    for (std::vector<sys::CThreadEngine*>::size_type i=0; i<_threads.size(); ++i)
+    {
+        _threads[i]->join();
+        delete _threads[i];
+    }
+    _threads.clear();
+
+    // 还在等待的异步请求以错误结束，同步等待者会超时
+    std::vector<std::pair<std::string, Waiter> > waiters;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        for (entry_table_t::iterator iter=_entry_table.begin(); iter!=_entry_table.end(); ++iter)
+        {
+            for (std::vector<Waiter>::size_type i=0; i<iter->second.waiters.size(); ++i)
+                waiters.push_back(std::make_pair(iter->first, iter->second.waiters[i]));
+            iter->second.waiters.clear();
+            iter->second.resolving = false;
+        }
+        _requests.clear();
+    }
+    for (std::vector<std::pair<std::string, Waiter> >::size_type i=0; i<waiters.size(); ++i)
+        deliver(waiters[i].first, waiters[i].second, ip_address_array_t(), "resolver destroyed");
+}
+
+CDnsResolver* CDnsResolver::get_default()
+{
+    // 不释放，进程退出时解析线程可能还在使用它
+    static CDnsResolver* resolver = NULL;
+    static sys::CLock lock;
+
+    if (NULL == __atomic_load_n(&resolver, __ATOMIC_ACQUIRE))
+    {
+        sys::LockHelper<sys::CLock> lock_helper(lock);
+        if (NULL == resolver)
+        {
+            CDnsResolver* default_resolver = new CDnsResolver;
+            default_resolver->create();
+            __atomic_store_n(&resolver, default_resolver, __ATOMIC_RELEASE);
+        }
+    }
+
+    return resolver;
+}
+
+bool CDnsResolver::resolve(const std::string& hostname, ip_address_array_t* ip_array, std::string* errinfo, uint32_t milliseconds)
+{
+    if (CUtils::is_valid_ip(hostname.c_str()))
+    {
+        ip_array->assign(1, ip_address_t(hostname.c_str()));
+        return true;
+    }
+
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    Entry& entry = _entry_table[hostname];
+    if (!use_cache(hostname, &entry, CEventLoop::get_monotonic_milliseconds()))
+    {
+        // 等待本次解析完成，invalidate不会删除正在解析的项，所以entry一直有效
+        const uint64_t generation = entry.generation;
+        const uint64_t deadline = CEventLoop::get_monotonic_milliseconds() + milliseconds;
+        while (generation == entry.generation)
+        {
+            const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+            if ((now >= deadline) || _stop)
+            {
+                *errinfo = "timeout";
+                return false;
+            }
+            (void)_resolved_event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+        }
+    }
+
+    *ip_array = entry.ip_array;
+    *errinfo = entry.errinfo;
+    return entry.ok;
+}
+
+void CDnsResolver::async_resolve(const std::string& hostname, IResolveHandler* handler, CEventLoop* event_loop)
+{
+    Waiter waiter;
+    waiter.handler = handler;
+    waiter.event_loop = event_loop;
+
+    if (CUtils::is_valid_ip(hostname.c_str()))
+    {
+        deliver(hostname, waiter, ip_address_array_t(1, ip_address_t(hostname.c_str())), std::string());
+        return;
+    }
+
+    ip_address_array_t ip_array;
+    std::string errinfo;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        Entry& entry = _entry_table[hostname];
+        if (!use_cache(hostname, &entry, CEventLoop::get_monotonic_milliseconds()))
+        {
+            entry.waiters.push_back(waiter);
+            return;
+        }
+
+        ip_array = entry.ip_array;
+        errinfo = entry.errinfo;
+    }
+
+    deliver(hostname, waiter, ip_array, errinfo);
+}
+
+void CDnsResolver::invalidate(const std::string& hostname)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    for (entry_table_t::iterator iter=_entry_table.begin(); iter!=_entry_table.end();)
+    {
+        if (!hostname.empty() && (iter->first != hostname))
+        {
+            ++iter;
+        }
+        else if (iter->second.resolving)
+        {
+            // 有等待者，只丢弃结果
+            iter->second.expire_time = 0;
+            iter->second.ok = false;
+            ++iter;
+        }
+        else
+        {
+            _entry_table.erase(iter++);
+        }
+    }
+}
+
+void CDnsResolver::sort_happy_eyeballs(ip_address_array_t* ip_array, bool prefer_ipv6)
+{
+    ip_address_array_t preferred, others;
+    for (ip_address_array_t::size_type i=0; i<ip_array->size(); ++i)
+    {
+        const ip_address_t& ip = (*ip_array)[i];
+        if (ip.is_ipv6() == prefer_ipv6)
+            preferred.push_back(ip);
+        else
+            others.push_back(ip);
+    }
+
+    // 首选地址族没有地址时，另一个地址族的第一个在前
+    ip_array->clear();
+    ip_address_array_t::size_type i = 0, j = 0;
+    while ((i < preferred.size()) || (j < others.size()))
+    {
+        if (i < preferred.size())
+            ip_array->push_back(preferred[i++]);
+        if (j < others.size())
+            ip_array->push_back(others[j++]);
+    }
+}
+
+bool CDnsResolver::blocking_resolve(const std::string& hostname, ip_address_array_t* ip_array, std::string* errinfo)
+{
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM; // 每个地址只返回一次
+    hints.ai_flags = AI_ADDRCONFIG;  // 本机没有IPv6地址时不返回IPv6地址
+
+    const int retval = ::getaddrinfo(hostname.c_str(), NULL, &hints, &result);
+    if ((retval != 0) || (NULL == result))
+    {
+        *errinfo = (EAI_SYSTEM == retval)? strerror(errno): gai_strerror(retval);
+        if (result != NULL)
+            freeaddrinfo(result);
+        return false;
+    }
+
+    ip_array->clear();
+    for (struct addrinfo* addr=result; addr!=NULL; addr=addr->ai_next)
+    {
+        if (AF_INET == addr->ai_family)
+            ip_array->push_back(ip_address_t(reinterpret_cast<struct sockaddr_in*>(addr->ai_addr)->sin_addr.s_addr));
+        else if (AF_INET6 == addr->ai_family)
+            ip_array->push_back(ip_address_t(reinterpret_cast<struct sockaddr_in6*>(addr->ai_addr)->sin6_addr.s6_addr32));
+    }
+
+    freeaddrinfo(result);
+    if (ip_array->empty())
+        *errinfo = "no address";
+    return !ip_array->empty();
+}
+
+void CDnsResolver::run()
+{
+    for (;;)
+    {
+        std::string hostname;
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            while (!_stop && _requests.empty())
+                (void)_request_event.timed_wait(_lock, 1000);
+            if (_stop)
+                break;
+
+            hostname = _requests.front();
+            _requests.pop_front();
+        }
+
+        ip_address_array_t ip_array;
+        std::string errinfo;
+        __atomic_add_fetch(&_lookup_number, 1, __ATOMIC_RELAXED);
+        const bool ok = blocking_resolve(hostname, &ip_array, &errinfo);
+        if (ok)
+            sort_happy_eyeballs(&ip_array, _prefer_ipv6);
+
+        std::vector<Waiter> waiters;
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            Entry& entry = _entry_table[hostname];
+            const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+
+            if (ok)
+            {
+                entry.ok = true;
+                entry.ip_array.swap(ip_array);
+                entry.errinfo.clear();
+                entry.expire_time = now + _positive_ttl;
+            }
+            else if (entry.ok && (entry.expire_time != 0) && (now < entry.expire_time + _stale_ttl))
+            {
+                // 刷新失败时继续使用之前的结果，negative_ttl之后再试
+                MYLOG_WARN("resolve %s error: %s, use the stale result\n", hostname.c_str(), errinfo.c_str());
+                entry.expire_time = now + _negative_ttl;
+            }
+            else
+            {
+                MYLOG_ERROR("resolve %s error: %s\n", hostname.c_str(), errinfo.c_str());
+                entry.ok = false;
+                entry.ip_array.clear();
+                entry.errinfo = errinfo;
+                entry.expire_time = now + _negative_ttl;
+            }
+
+            entry.resolved_time = now;
+            entry.resolving = false;
+            ++entry.generation;
+            waiters.swap(entry.waiters);
+            ip_array = entry.ip_array;
+            errinfo = entry.errinfo;
+            _resolved_event.broadcast();
+        }
+
+        for (std::vector<Waiter>::size_type i=0; i<waiters.size(); ++i)
+            deliver(hostname, waiters[i], ip_array, errinfo);
+    }
+}
+
+void CDnsResolver::save_snapshot(sys::CSnapshotWriter* writer)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+
+    for (entry_table_t::const_iterator iter=_entry_table.begin(); iter!=_entry_table.end(); ++iter)
+    {
+        const Entry& entry = iter->second;
+        if (!entry.ok || (0 == entry.expire_time))
+            continue;
+
+        // 剩余的有效期，已过期（在stale_ttl内）的为负数
+        writer->write_string(iter->first);
+        writer->write_uint64(static_cast<uint64_t>(static_cast<int64_t>(entry.expire_time) - static_cast<int64_t>(now)));
+        writer->write_uint32(static_cast<uint32_t>(entry.ip_array.size()));
+        for (ip_address_array_t::size_type i=0; i<entry.ip_array.size(); ++i)
+        {
+            uint32_t address_data[4] = { 0, 0, 0, 0 };
+            const ip_address_t& ip = entry.ip_array[i];
+            memcpy(address_data, ip.get_address_data(), ip.get_address_data_length());
+            writer->write_uint32(ip.is_ipv6()? 1: 0);
+            writer->write(address_data, sizeof(address_data));
+        }
+    }
+}
+
+bool CDnsResolver::load_snapshot(sys::CSnapshotReader* reader)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    const int64_t now = static_cast<int64_t>(CEventLoop::get_monotonic_milliseconds());
+    const int64_t elapsed_milliseconds = static_cast<int64_t>(reader->get_elapsed_milliseconds());
+
+    while (!reader->eof())
+    {
+        std::string hostname;
+        uint64_t remaining_milliseconds;
+        uint32_t ip_number;
+        if (!reader->read_string(&hostname) || !reader->read_uint64(&remaining_milliseconds) || !reader->read_uint32(&ip_number))
+            return false;
+
+        ip_address_array_t ip_array;
+        for (uint32_t i=0; i<ip_number; ++i)
+        {
+            uint32_t is_ipv6;
+            uint32_t address_data[4];
+            if (!reader->read_uint32(&is_ipv6) || !reader->read(address_data, sizeof(address_data)))
+                return false;
+            if (is_ipv6)
+                ip_array.push_back(ip_address_t(address_data));
+            else
+                ip_array.push_back(ip_address_t(address_data[0]));
+        }
+
+        const int64_t expire_time = now + static_cast<int64_t>(remaining_milliseconds) - elapsed_milliseconds;
+        if (ip_array.empty() || (expire_time <= 0) || (expire_time + static_cast<int64_t>(_stale_ttl) <= now))
+            continue;
+
+        // 已有结果（进程先解析过）的不覆盖
+        Entry& entry = _entry_table[hostname];
+        if (entry.expire_time != 0)
+            continue;
+        entry.ok = true;
+        entry.resolved_time = static_cast<uint64_t>(now);
+        entry.expire_time = static_cast<uint64_t>(expire_time);
+        entry.ip_array.swap(ip_array);
+        entry.errinfo.clear();
+    }
+    return true;
+}
+
+// 调用者须已持有_lock
+void CDnsResolver::request(const std::string& hostname, Entry* entry)
+{
+    entry->resolving = true;
+    _requests.push_back(hostname);
+    _request_event.signal();
+}
+
+// 调用者须已持有_lock，返回缓存的结果是否可用，需要时发起解析
+bool CDnsResolver::use_cache(const std::string& hostname, Entry* entry, uint64_t now)
+{
+    if ((entry->expire_time != 0) && (now < entry->expire_time))
+    {
+        // 成功的结果快过期时提前刷新
+        __atomic_add_fetch(&_hit_number, 1, __ATOMIC_RELAXED);
+        if (entry->ok && !entry->resolving && (_prefetch_ratio > 0)
+         && (now + static_cast<uint64_t>(_positive_ttl * _prefetch_ratio) >= entry->expire_time))
+        {
+            __atomic_add_fetch(&_prefetch_number, 1, __ATOMIC_RELAXED);
+            request(hostname, entry);
+        }
+        return true;
+    }
+
+    if (!entry->resolving)
+        request(hostname, entry);
+
+    // 过期的成功结果在stale_ttl内仍可用，刷新在后台进行
+    if (entry->ok && (entry->expire_time != 0) && (now < entry->expire_time + _stale_ttl))
+    {
+        __atomic_add_fetch(&_stale_number, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    __atomic_add_fetch(&_miss_number, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+void CDnsResolver::deliver(const std::string& hostname, const Waiter& waiter, const ip_address_array_t& ip_array, const std::string& errinfo)
+{
+    if (waiter.event_loop != NULL)
+        waiter.event_loop->post(new CResolveTask(waiter.handler, hostname, ip_array, errinfo));
+    else
+        waiter.handler->on_resolved(hostname, ip_array, errinfo);
+}
+
+NET_NAMESPACE_END
@@ -19,6 +19,17 @@
 #include <signal.h>
 #include "net/utils.h"
 #include "net/epollable.h"
+#include <linux/net_tstamp.h>
+#include <stdio.h>
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
 NET_NAMESPACE_BEGIN
 
 // CIgnorePipeSignal的作用是用来自动将PIPE信号忽略
@@ -69,7 +80,13 @@ bool is_nonblock(int fd)
   */
 bool is_nodelay(int fd)
 {
-    return has_the_flags(fd, O_NDELAY);
+    // O_NDELAY即O_NONBLOCK，非延迟指的是TCP_NODELAY
+    int on = 0;
+    socklen_t on_length = sizeof(on);
+    if (-1 == getsockopt(fd, SOL_TCP, TCP_NODELAY, &on, &on_length))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "getsockopt");
+
+    return on != 0;
 }
 
 /***
@@ -129,7 +146,7 @@ void set_nonblock(int fd, bool yes)
   */
 void set_nodelay(int fd, bool yes)
 {
-    set_socket_flags(fd, yes, O_NDELAY);
+    set_tcp_option(fd, yes, TCP_NODELAY);
 }
 
 void close_fd(int fd) throw ()
@@ -143,6 +160,8 @@ void close_fd(int fd) throw ()
 CEpollable::CEpollable()
     :_fd(-1)
     ,_epoll_events(-1)
+    ,_tenant(0)
+    ,_again_queued(false)
 {
 }
 
@@ -151,6 +170,13 @@ CEpollable::~CEpollable()
     this->close();
 }
 
+std::string CEpollable::to_string() const
+{
+    char buffer[sizeof("fd:-2147483648")];
+    (void)snprintf(buffer, sizeof(buffer), "fd:%d", _fd);
+    return buffer;
+}
+
 void CEpollable::do_close()
 {       
     if (_fd != -1)
@@ -228,6 +254,30 @@ void CEpollable::set_nodelay(bool yes)
 	net::set_nodelay(_fd, yes);
 }
 
+bool CEpollable::set_busy_poll(uint32_t usecs, bool prefer, uint16_t budget)
+{
+    int value = static_cast<int>(usecs);
+    if (-1 == setsockopt(_fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)))
+        return false;
+
+    value = prefer? 1: 0;
+    (void)setsockopt(_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value));
+    if (budget > 0)
+    {
+        value = budget;
+        (void)setsockopt(_fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &value, sizeof(value));
+    }
+    return true;
+}
+
+bool CEpollable::enable_timestamping(bool hardware)
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (hardware)
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    return 0 == setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
 int CEpollable::get_socket_error_code()
 {
     int error_code;
@@ -18,13 +18,28 @@
  */
 #include <sys/syscall_exception.h>
 #include "net/epoller.h"
+#include <string.h>
+#include <sys/ioctl.h>
+#ifndef EPIOCSPARAMS
+// 同linux/eventpoll.h，旧的头文件中没有
+struct epoll_params
+{
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif // EPIOCSPARAMS
 NET_NAMESPACE_BEGIN
 
 CEpoller::CEpoller()
     :_epfd(-1)
     ,_epoll_size(0)
     ,_max_events(0)
+    ,_trigger_flags(0)
     ,_events(NULL)
+    ,_results(NULL)
 {
 }
 
@@ -33,12 +48,15 @@ CEpoller::~CEpoller()
     destroy();
     delete []_events;
     _events = NULL;
+    delete []_results;
+    _results = NULL;
 }
 
-void CEpoller::create(uint32_t epoll_size)
+void CEpoller::create(uint32_t epoll_size, uint32_t trigger_flags)
 {
     _epoll_size = epoll_size;
 	_max_events = epoll_size;
+    _trigger_flags = trigger_flags & (EPOLLET|EPOLLONESHOT);
     
     _events = new struct epoll_event[_epoll_size];
     _epfd = epoll_create(_epoll_size);
@@ -64,6 +82,16 @@ void CEpoller::destroy()
     }  
 }
 
+bool CEpoller::set_busy_poll(uint32_t usecs, uint16_t budget, bool prefer)
+{
+    struct epoll_params params;
+    memset(&params, 0, sizeof(params));
+    params.busy_poll_usecs = usecs;
+    params.busy_poll_budget = budget;
+    params.prefer_busy_poll = prefer? 1: 0;
+    return 0 == ioctl(_epfd, EPIOCSPARAMS, &params);
+}
+
 int CEpoller::timed_wait(uint32_t milliseconds)
 {
     int retval;
@@ -88,11 +116,39 @@ int CEpoller::timed_wait(uint32_t milliseconds)
     return retval;
 }
 
+int CEpoller::dispatch(uint32_t milliseconds, IEpollDispatcher* dispatcher, void* input_ptr)
+{
+    const int n = timed_wait(milliseconds);
+
+    if (n > 0)
+    {
+        if (NULL == _results)
+            _results = new epoll_result_t[_max_events];
+
+        for (int i=0; i<n; ++i)
+        {
+            CEpollable* epollable = get(i);
+
+            _results[i].epollable = epollable;
+            _results[i].events = _events[i].events;
+            _results[i].result = epollable->handle_epoll_event(input_ptr, _events[i].events, NULL);
+        }
+        if (dispatcher != NULL)
+            dispatcher->on_dispatched(this, _results, n);
+    }
+
+    return n;
+}
+
 void CEpoller::set_events(CEpollable* epollable, int events, bool force)
 {
     int fd = epollable->get_fd();
     if (fd != -1)
     {
+        // 感应器总是水平触发，否则wakeup可能失效
+        if (epollable != &_sensor)
+            events |= _trigger_flags;
+
         // EPOLLIN, EPOLLOUT    
         int old_epoll_events = force? -1: epollable->get_epoll_events();
         if (old_epoll_events == events) return;
@@ -111,6 +167,21 @@ void CEpoller::set_events(CEpollable* epollable, int events, bool force)
     }
 }
 
+void CEpoller::rearm(CEpollable* epollable)
+{
+    int fd = epollable->get_fd();
+    if (fd != -1)
+    {
+        struct epoll_event event;
+        event.data.u64 = 0;
+        event.data.ptr = epollable;
+        event.events = epollable->get_epoll_events();
+
+        if (-1 == epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &event))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "epoll_ctl");
+    }
+}
+
 void CEpoller::del_events(CEpollable* epollable)
 {
     int fd = epollable->get_fd();
@@ -0,0 +1,827 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/event_loop.h"
+#include "net/write_coalescer.h"
+#include "sys/log.h"
+#include "sys/metrics.h"
+#include "sys/spin_lock.h"
+#include "sys/utils.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <limits>
+#include <sched.h>
+#include <time.h>
+NET_NAMESPACE_BEGIN
+
+// 没有定时器时，epoll_wait的最长等待毫秒数
+#define LOOP_IDLE_MILLISECONDS 1000
+
+// 所有事件循环共用的度量，dispatch_ns为一轮处理事件、任务和flush的耗时，pending_tasks为已post还未执行的任务数
+static sys::CCounter* get_events_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("reactor.events");
+    return counter;
+}
+
+static sys::CLatencyHistogram* get_dispatch_histogram()
+{
+    static sys::CLatencyHistogram* histogram = sys::CMetricsRegistry::get_singleton()->get_histogram("reactor.dispatch_ns");
+    return histogram;
+}
+
+// 返回epoll_again即预算用完仍有数据的次数
+static sys::CCounter* get_budget_exhausted_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("reactor.budget_exhausted");
+    return counter;
+}
+
+static sys::CCounter* get_expired_tasks_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("reactor.expired_tasks");
+    return counter;
+}
+
+static sys::CGauge* get_pending_tasks_gauge()
+{
+    static sys::CGauge* gauge = sys::CMetricsRegistry::get_singleton()->get_gauge("reactor.pending_tasks");
+    return gauge;
+}
+
+static std::string get_loop_metric_name(uint16_t index, const char* name)
+{
+    return std::string("reactor.loop") + utils::CStringUtils::int_tostring(index) + std::string(".") + name;
+}
+
+// 用于post_add的任务
+class CAddTask: public ILoopTask
+{
+public:
+    CAddTask(CEpollable* epollable, int events)
+        : _epollable(epollable), _events(events)
+    {
+        _epollable->inc_refcount();
+    }
+
+    ~CAddTask()
+    {
+        _epollable->dec_refcount();
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        event_loop->add(_epollable, _events);
+    }
+
+private:
+    CEpollable* _epollable;
+    int _events;
+};
+
+// 用于批量post_add的任务
+class CAddBatchTask: public ILoopTask
+{
+public:
+    CAddBatchTask(CEpollable* const* epollables, uint32_t number, int events)
+        : _epollables(epollables, epollables+number), _events(events)
+    {
+        for (std::vector<CEpollable*>::size_type i=0; i<_epollables.size(); ++i)
+            _epollables[i]->inc_refcount();
+    }
+
+    ~CAddBatchTask()
+    {
+        for (std::vector<CEpollable*>::size_type i=0; i<_epollables.size(); ++i)
+            _epollables[i]->dec_refcount();
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        // 一个加入失败不影响其它的
+        for (std::vector<CEpollable*>::size_type i=0; i<_epollables.size(); ++i)
+        {
+            try
+            {
+                event_loop->add(_epollables[i], _events);
+            }
+            catch (sys::CSyscallException& ex)
+            {
+                MYLOG_ERROR("loop[%d] add fd %d error: %s\n", event_loop->get_index(), _epollables[i]->get_fd(), ex.str().c_str());
+            }
+        }
+    }
+
+private:
+    std::vector<CEpollable*> _epollables;
+    int _events;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+CEventLoop::CEventLoop(uint16_t index, uint32_t epoll_size, int cpu)
+    : _index(index)
+    , _cpu(cpu)
+    , _loop_thread(0)
+    , _epollable_number(0)
+    , _tasks_per_round(64)
+    , _idle_rounds(0)
+    , _polling(false)
+    , _dispatching(false)
+    , _slow_handler_nanoseconds(0)
+    , _work_number(0)
+    , _next_timer_id(0)
+{
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    _iteration_histogram = registry->get_histogram(get_loop_metric_name(index, "iteration_ns"));
+    _events_histogram = registry->get_histogram(get_loop_metric_name(index, "events_per_wait"));
+    _timer_lag_histogram = registry->get_histogram(get_loop_metric_name(index, "timer_lag_ms"));
+    _busy_counter = registry->get_counter(get_loop_metric_name(index, "busy_ns"));
+    _wait_counter = registry->get_counter(get_loop_metric_name(index, "wait_ns"));
+    _slow_handlers_counter = registry->get_counter(get_loop_metric_name(index, "slow_handlers"));
+    _pending_tasks_gauge = registry->get_gauge(get_loop_metric_name(index, "pending_tasks"));
+    set_name("reactor.loop" + utils::CStringUtils::int_tostring(index));
+    _epoller.create(epoll_size);
+}
+
+CEventLoop::~CEventLoop()
+{
+    for (std::vector<PostedTask>::size_type i=0; i<_task_queue.size(); ++i)
+        delete _task_queue[i].task;
+    get_pending_tasks_gauge()->add(-static_cast<int64_t>(_task_queue.size() + _scheduled_tasks.size()));
+    _pending_tasks_gauge->add(-static_cast<int64_t>(_task_queue.size() + _scheduled_tasks.size()));
+    _task_queue.clear();
+
+    PostedTask posted_task;
+    while (_scheduled_tasks.pop(0, &posted_task, NULL))
+        delete posted_task.task;
+
+    for (std::vector<again_t>::size_type i=0; i<_again_queue.size(); ++i)
+    {
+        _again_queue[i].first->_again_queued = false;
+        _again_queue[i].first->dec_refcount();
+    }
+    _epoller.destroy();
+}
+
+bool CEventLoop::in_loop_thread() const
+{
+    return pthread_equal(_loop_thread, pthread_self()) != 0;
+}
+
+uint32_t CEventLoop::get_epollable_number() const
+{
+    return __atomic_load_n(&_epollable_number, __ATOMIC_RELAXED);
+}
+
+void CEventLoop::add(CEpollable* epollable, int events)
+{
+    _epoller.set_events(epollable, events, true);
+    epollable->inc_refcount();
+    __atomic_add_fetch(&_epollable_number, 1, __ATOMIC_RELAXED);
+}
+
+void CEventLoop::modify(CEpollable* epollable, int events)
+{
+    _epoller.set_events(epollable, events);
+}
+
+void CEventLoop::remove(CEpollable* epollable, bool close_it)
+{
+    try
+    {
+        _epoller.del_events(epollable);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("loop[%d] del_events error: %s\n", _index, ex.str().c_str());
+    }
+
+    if (close_it)
+        epollable->close();
+    __atomic_sub_fetch(&_epollable_number, 1, __ATOMIC_RELAXED);
+
+    // 同一批就绪事件中可能还有该对象，延迟到本批处理完后再减引用计数
+    if (_dispatching)
+        _removed.push_back(epollable);
+    else
+        epollable->dec_refcount();
+}
+
+void CEventLoop::post(ILoopTask* task)
+{
+    PostedTask posted_task;
+    posted_task.task = task;
+    push_task(&posted_task);
+}
+
+void CEventLoop::post(utils::Functor<void> functor)
+{
+    PostedTask posted_task;
+    posted_task.task = NULL;
+    posted_task.functor = static_cast<utils::Functor<void>&&>(functor);
+    push_task(&posted_task);
+}
+
+void CEventLoop::post(ILoopTask* task, const sys::CTaskPriority& priority)
+{
+    PostedTask posted_task;
+    posted_task.task = task;
+    push_task(&posted_task, &priority);
+}
+
+void CEventLoop::post(utils::Functor<void> functor, const sys::CTaskPriority& priority)
+{
+    PostedTask posted_task;
+    posted_task.task = NULL;
+    posted_task.functor = static_cast<utils::Functor<void>&&>(functor);
+    push_task(&posted_task, &priority);
+}
+
+void CEventLoop::set_task_lanes(const std::vector<uint32_t>& lane_weights, uint32_t tasks_per_round)
+{
+    _scheduled_tasks.set_lanes(lane_weights);
+    _tasks_per_round = (0 == tasks_per_round)? 1: tasks_per_round;
+}
+
+void CEventLoop::push_task(PostedTask* posted_task, const sys::CTaskPriority* priority)
+{
+    bool need_wakeup;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_task_lock);
+        // 队列非空时，之前的post已经唤醒过了
+        need_wakeup = _task_queue.empty() && _scheduled_tasks.empty();
+        if (NULL == priority)
+            _task_queue.push_back(static_cast<PostedTask&&>(*posted_task));
+        else
+            _scheduled_tasks.push(*posted_task, *priority);
+    }
+
+    get_pending_tasks_gauge()->add(1);
+    _pending_tasks_gauge->add(1);
+    // 先入队再检查是否在轮询，和wait_events中先取消轮询再检查任务配对，保证不会漏掉唤醒
+    if (need_wakeup && !__atomic_load_n(&_polling, __ATOMIC_SEQ_CST))
+        _epoller.wakeup();
+}
+
+void CEventLoop::post_add(CEpollable* epollable, int events)
+{
+    post(new CAddTask(epollable, events));
+}
+
+void CEventLoop::post_add(CEpollable* const* epollables, uint32_t number, int events)
+{
+    if (number > 0)
+        post(new CAddBatchTask(epollables, number, events));
+}
+
+uint64_t CEventLoop::run_after(uint32_t milliseconds, ITimerHandler* handler)
+{
+    const uint64_t timer_id = ++_next_timer_id;
+    const uint64_t expire = get_monotonic_milliseconds() + milliseconds;
+
+    _timer_table.insert(std::make_pair(timer_key_t(expire, timer_id), handler));
+    _timer_index.insert(std::make_pair(timer_id, expire));
+    return timer_id;
+}
+
+bool CEventLoop::cancel_timer(uint64_t timer_id)
+{
+    timer_index_t::iterator iter = _timer_index.find(timer_id);
+    if (iter == _timer_index.end())
+        return false;
+
+    _timer_table.erase(timer_key_t(iter->second, timer_id));
+    _timer_index.erase(iter);
+    return true;
+}
+
+bool CEventLoop::set_busy_poll(uint32_t usecs, uint16_t budget, bool prefer)
+{
+    _idle_strategy = sys::CIdleStrategy(sys::idle_busy_spin);
+    return _epoller.set_busy_poll(usecs, budget, prefer);
+}
+
+void CEventLoop::set_io_budget(uint32_t bytes, uint32_t messages)
+{
+    _io_budget.bytes = bytes;
+    _io_budget.messages = messages;
+}
+
+void CEventLoop::set_tenant_weight(uint16_t tenant, uint32_t weight)
+{
+    if (tenant >= _tenant_weights.size())
+        _tenant_weights.resize(tenant+1, 1);
+    _tenant_weights[tenant] = (0 == weight)? 1: weight;
+}
+
+CIoBudget CEventLoop::get_io_budget(const CEpollable* epollable) const
+{
+    const uint16_t tenant = epollable->get_tenant();
+    if (tenant >= _tenant_weights.size())
+        return _io_budget;
+
+    // 乘积超过uint32_t时取最大值，仍不为0（0表示不限制）
+    const uint64_t weight = _tenant_weights[tenant];
+    return CIoBudget(static_cast<uint32_t>(std::min<uint64_t>(_io_budget.bytes * weight, std::numeric_limits<uint32_t>::max())),
+                     static_cast<uint32_t>(std::min<uint64_t>(_io_budget.messages * weight, std::numeric_limits<uint32_t>::max())));
+}
+
+uint64_t CEventLoop::get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void CEventLoop::before_stop()
+{
+    _epoller.wakeup();
+}
+
+void CEventLoop::run()
+{
+    _loop_thread = pthread_self();
+    if (_cpu >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(_cpu, &cpu_set);
+
+        const int errcode = pthread_setaffinity_np(_loop_thread, sizeof(cpu_set), &cpu_set);
+        if (errcode != 0)
+            MYLOG_ERROR("loop[%d] bind to cpu[%d] error: %s\n", _index, _cpu, sys::CUtils::get_error_message(errcode).c_str());
+    }
+
+    while (!is_stop())
+    {
+        try
+        {
+            // 有待再次调用的对象时不等待
+            const uint64_t iteration_nanoseconds = sys::CClock::get_nanoseconds();
+            _work_number = 0;
+            const int milliseconds = run_timers();
+            const uint64_t wait_nanoseconds = sys::CClock::get_nanoseconds();
+            const int n = wait_events(_again_queue.empty()? milliseconds: 0);
+            const uint64_t start_nanoseconds = sys::CClock::get_nanoseconds();
+
+            handle_events(n);
+            run_tasks();
+            flush_coalescers();
+            (void)sys::CBiasedRefCount::merge_pending(); // 回收其它线程交回的偏向计数对象
+
+            const uint64_t end_nanoseconds = sys::CClock::get_nanoseconds();
+            _busy_counter->inc((wait_nanoseconds - iteration_nanoseconds) + (end_nanoseconds - start_nanoseconds));
+            _wait_counter->inc(start_nanoseconds - wait_nanoseconds);
+            if (n > 0)
+            {
+                get_events_counter()->inc(n);
+                get_dispatch_histogram()->record(end_nanoseconds - start_nanoseconds);
+                _events_histogram->record(static_cast<uint64_t>(n));
+            }
+            if ((n > 0) || (_work_number > 0))
+                _iteration_histogram->record(end_nanoseconds - iteration_nanoseconds);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            MYLOG_ERROR("loop[%d] error: %s\n", _index, ex.str().c_str());
+        }
+    }
+
+    // 退出前执行完所有的任务
+    while (run_tasks())
+        ;
+    flush_coalescers();
+}
+
+void CEventLoop::handle_events(int n)
+{
+    _dispatching = true;
+    // 上一轮返回epoll_again的，在本轮就绪的对象之后再次调用，本轮新返回的留到下一轮
+    _running_again.swap(_again_queue);
+
+    for (int i=0; i<n; ++i)
+    {
+        CEpollable* epollable = _epoller.get(i);
+        // 已在本批中被剔除，或等着在本轮的最后再次调用
+        if ((-1 == epollable->get_epoll_events()) || epollable->_again_queued)
+            continue;
+
+        handle_result(epollable, _epoller.get_events(i), dispatch(epollable, _epoller.get_events(i)));
+    }
+
+    handle_again();
+    _dispatching = false;
+    release_removed();
+}
+
+void CEventLoop::handle_again()
+{
+    for (std::vector<again_t>::size_type i=0; i<_running_again.size(); ++i)
+    {
+        CEpollable* epollable = _running_again[i].first;
+        epollable->_again_queued = false;
+        // 等待期间已被剔除
+        if (-1 == epollable->get_epoll_events())
+            continue;
+
+        handle_result(epollable, _running_again[i].second, dispatch(epollable, _running_again[i].second));
+    }
+
+    // 和_removed一样，在本批处理完后才减引用计数，重新排入队列的已另外增加了
+    for (std::vector<again_t>::size_type i=0; i<_running_again.size(); ++i)
+        _removed.push_back(_running_again[i].first);
+    _running_again.clear();
+}
+
+// 调用handle_epoll_event，设置了慢处理的阈值时计时，超过的输出对象的身份
+epoll_event_t CEventLoop::dispatch(CEpollable* epollable, uint32_t events)
+{
+    const uint64_t start_nanoseconds = (0 == _slow_handler_nanoseconds)? 0: sys::CClock::get_nanoseconds();
+    epoll_event_t result;
+
+    try
+    {
+        result = epollable->handle_epoll_event(this, events, NULL);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("loop[%d] handle fd[%d] error: %s\n", _index, epollable->get_fd(), ex.str().c_str());
+        result = epoll_close;
+    }
+
+    if (_slow_handler_nanoseconds > 0)
+    {
+        const uint64_t nanoseconds = sys::CClock::get_nanoseconds() - start_nanoseconds;
+        if (nanoseconds > _slow_handler_nanoseconds)
+        {
+            _slow_handlers_counter->inc();
+            MYLOG_WARN_RATELIMIT(10, "loop[%d] slow handler %s: events=0x%x, %" PRIu64 "us\n",
+                _index, epollable->to_string().c_str(), events, nanoseconds / 1000);
+        }
+    }
+    return result;
+}
+
+void CEventLoop::handle_result(CEpollable* epollable, uint32_t events, epoll_event_t result)
+{
+    switch (result)
+    {
+    case epoll_again:
+        if (!epollable->_again_queued)
+        {
+            epollable->_again_queued = true;
+            epollable->inc_refcount();
+            _again_queue.push_back(again_t(epollable, events));
+            get_budget_exhausted_counter()->inc();
+        }
+        break;
+    case epoll_read:
+        modify(epollable, EPOLLIN);
+        break;
+    case epoll_write:
+        modify(epollable, EPOLLOUT);
+        break;
+    case epoll_read_write:
+        modify(epollable, EPOLLIN|EPOLLOUT);
+        break;
+    case epoll_close:
+    case epoll_destroy:
+        remove(epollable, true);
+        break;
+    case epoll_remove:
+    case epoll_release:
+        remove(epollable, false);
+        break;
+    default:
+        break;
+    }
+}
+
+// 单CPU时投递的线程不可能和轮询同时运行，轮询时都改为让出CPU
+static bool is_multi_cpu()
+{
+    static const bool multi_cpu = sys::CUtils::get_cpu_number() > 1;
+    return multi_cpu;
+}
+
+int CEventLoop::wait_events(int milliseconds)
+{
+    if ((sys::idle_block == _idle_strategy.type) || (0 == milliseconds))
+        return _epoller.timed_wait(static_cast<uint32_t>(milliseconds));
+
+    const bool polling = (sys::idle_busy_spin == _idle_strategy.type) || (sys::idle_spin_yield == _idle_strategy.type)
+                      || (_idle_rounds < _idle_strategy.spin_number + _idle_strategy.yield_number);
+    if (polling)
+    {
+        __atomic_store_n(&_polling, true, __ATOMIC_SEQ_CST);
+        if (is_multi_cpu() && ((sys::idle_busy_spin == _idle_strategy.type) || (_idle_rounds < _idle_strategy.spin_number)))
+            SPIN_LOCK_PAUSE();
+        else
+            (void)sched_yield();
+        if (_idle_rounds < std::numeric_limits<uint32_t>::max())
+            ++_idle_rounds;
+
+        const int n = _epoller.timed_wait(0);
+        if (n > 0)
+            _idle_rounds = 0;
+        return n;
+    }
+
+    // 进入阻塞前先取消轮询，再检查是否已有任务，有则不阻塞
+    bool has_tasks;
+    __atomic_store_n(&_polling, false, __ATOMIC_SEQ_CST);
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_task_lock);
+        has_tasks = !_task_queue.empty() || !_scheduled_tasks.empty();
+    }
+
+    _idle_rounds = 0; // 醒来后重新开始轮询
+    return _epoller.timed_wait(has_tasks? 0: static_cast<uint32_t>(milliseconds));
+}
+
+// 返回是否还有带调度属性的任务留到下一轮
+bool CEventLoop::run_tasks()
+{
+    bool remaining;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_task_lock);
+        if (_task_queue.empty() && _scheduled_tasks.empty())
+            return false;
+        _running_tasks.swap(_task_queue);
+        _idle_rounds = 0;
+
+        // 带调度属性的接在后面，按调度的次序取本轮的份额
+        const uint64_t now_milliseconds = sys::CClock::get_milliseconds();
+        PostedTask posted_task;
+        for (uint32_t i=0; i<_tasks_per_round; ++i)
+        {
+            if (!_scheduled_tasks.pop(now_milliseconds, &posted_task, &_expired_tasks))
+                break;
+            _running_tasks.push_back(static_cast<PostedTask&&>(posted_task));
+        }
+        remaining = !_scheduled_tasks.empty();
+    }
+    get_pending_tasks_gauge()->add(-static_cast<int64_t>(_running_tasks.size() + _expired_tasks.size()));
+    _pending_tasks_gauge->add(-static_cast<int64_t>(_running_tasks.size() + _expired_tasks.size()));
+
+    if (!_expired_tasks.empty())
+    {
+        get_expired_tasks_counter()->inc(_expired_tasks.size());
+        for (std::vector<PostedTask>::size_type i=0; i<_expired_tasks.size(); ++i)
+            delete _expired_tasks[i].task;
+        _expired_tasks.clear();
+    }
+    for (std::vector<PostedTask>::size_type i=0; i<_running_tasks.size(); ++i)
+        run_task(&_running_tasks[i]);
+    _work_number += static_cast<uint32_t>(_running_tasks.size());
+    _running_tasks.clear();
+
+    // 剩下的不等下一个事件，让下一轮的epoll立即返回
+    if (remaining)
+        _epoller.wakeup();
+    return remaining;
+}
+
+void CEventLoop::run_task(PostedTask* posted_task)
+{
+    ILoopTask* task = posted_task->task;
+
+    try
+    {
+        if (task != NULL)
+            task->execute(this);
+        else
+            posted_task->functor();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("loop[%d] task error: %s\n", _index, ex.str().c_str());
+    }
+
+    delete task;
+}
+
+int CEventLoop::run_timers()
+{
+    const uint64_t now = get_monotonic_milliseconds();
+
+    while (!_timer_table.empty())
+    {
+        timer_table_t::iterator iter = _timer_table.begin();
+        if (iter->first.first > now)
+        {
+            const uint64_t milliseconds = iter->first.first - now;
+            return (milliseconds < LOOP_IDLE_MILLISECONDS)? static_cast<int>(milliseconds): LOOP_IDLE_MILLISECONDS;
+        }
+
+        const uint64_t timer_id = iter->first.second;
+        ITimerHandler* handler = iter->second;
+        _timer_lag_histogram->record(now - iter->first.first);
+        _timer_table.erase(iter);
+        _timer_index.erase(timer_id);
+        ++_work_number;
+
+        uint32_t interval;
+        if (0 == _slow_handler_nanoseconds)
+        {
+            interval = handler->on_timer(this, timer_id);
+        }
+        else
+        {
+            const uint64_t start_nanoseconds = sys::CClock::get_nanoseconds();
+            interval = handler->on_timer(this, timer_id);
+
+            const uint64_t nanoseconds = sys::CClock::get_nanoseconds() - start_nanoseconds;
+            if (nanoseconds > _slow_handler_nanoseconds)
+            {
+                _slow_handlers_counter->inc();
+                MYLOG_WARN_RATELIMIT(10, "loop[%d] slow timer[%" PRIu64 "]: %" PRIu64 "us\n", _index, timer_id, nanoseconds / 1000);
+            }
+        }
+        if (interval > 0)
+        {
+            // 保持定时器ID不变，便于调用者cancel
+            const uint64_t expire = now + interval;
+            _timer_table.insert(std::make_pair(timer_key_t(expire, timer_id), handler));
+            _timer_index.insert(std::make_pair(timer_id, expire));
+        }
+    }
+
+    return LOOP_IDLE_MILLISECONDS;
+}
+
+void CEventLoop::release_removed()
+{
+    for (std::vector<CEpollable*>::size_type i=0; i<_removed.size(); ++i)
+        _removed[i]->dec_refcount();
+    _removed.clear();
+}
+
+void CEventLoop::flush_later(CWriteCoalescer* coalescer)
+{
+    _flush_queue.push_back(coalescer);
+}
+
+void CEventLoop::cancel_flush(CWriteCoalescer* coalescer)
+{
+    std::vector<CWriteCoalescer*>::iterator iter = std::find(_flush_queue.begin(), _flush_queue.end(), coalescer);
+    if (iter != _flush_queue.end())
+        _flush_queue.erase(iter);
+}
+
+// 一轮中的写都已完成，推出各连接攒着的数据
+void CEventLoop::flush_coalescers()
+{
+    while (!_flush_queue.empty())
+    {
+        CWriteCoalescer* coalescer = _flush_queue.back();
+        _flush_queue.pop_back();
+        coalescer->_flush_pending = false;
+        coalescer->flush();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CReactorPool::CReactorPool()
+    : _assign_policy(assign_round_robin)
+    , _next_loop(0)
+{
+}
+
+CReactorPool::~CReactorPool()
+{
+    destroy();
+}
+
+void CReactorPool::create(uint16_t loop_number, uint32_t epoll_size, bool pin_cpu)
+{
+    const uint16_t cpu_number = sys::CUtils::get_cpu_number();
+    if (0 == loop_number)
+        loop_number = (cpu_number > 0)? cpu_number: 1;
+
+    for (uint16_t i=0; i<loop_number; ++i)
+    {
+        try
+        {
+            const int cpu = (pin_cpu && (cpu_number > 0))? (i % cpu_number): -1;
+            CEventLoop* event_loop = new CEventLoop(i, epoll_size, cpu);
+
+            event_loop->inc_refcount();
+            _loop_array.push_back(event_loop);
+            event_loop->start();
+        }
+        catch (...)
+        {
+            destroy();
+            throw;
+        }
+    }
+}
+
+void CReactorPool::destroy()
+{
+    for (std::vector<CEventLoop*>::size_type i=_loop_array.size(); i>0; --i)
+    {
+        CEventLoop* event_loop = _loop_array[i-1];
+        event_loop->stop();
+        event_loop->dec_refcount();
+    }
+
+    _loop_array.clear();
+}
+
+CEventLoop* CReactorPool::get_loop(uint16_t index) const
+{
+    if (index >= _loop_array.size())
+        return NULL;
+    return _loop_array[index];
+}
+
+CEventLoop* CReactorPool::next_loop()
+{
+    if (_loop_array.empty())
+        return NULL;
+
+    if (assign_least_loaded == _assign_policy)
+    {
+        CEventLoop* selected = _loop_array[0];
+        uint32_t min_number = selected->get_epollable_number();
+
+        for (std::vector<CEventLoop*>::size_type i=1; i<_loop_array.size(); ++i)
+        {
+            const uint32_t number = _loop_array[i]->get_epollable_number();
+            if (number < min_number)
+            {
+                min_number = number;
+                selected = _loop_array[i];
+            }
+        }
+
+        return selected;
+    }
+
+    const uint32_t next = __atomic_fetch_add(&_next_loop, 1, __ATOMIC_RELAXED);
+    return _loop_array[next % _loop_array.size()];
+}
+
+CEventLoop* CReactorPool::assign(CEpollable* epollable, int events)
+{
+    CEventLoop* event_loop = next_loop();
+    if (event_loop != NULL)
+        event_loop->post_add(epollable, events);
+    return event_loop;
+}
+
+void CReactorPool::assign(CEpollable* const* epollables, uint32_t number, int events)
+{
+    if (_loop_array.empty() || (0 == number))
+        return;
+
+    // 先按策略分组，再对每个循环投递一次
+    std::vector<std::vector<CEpollable*> > groups(_loop_array.size());
+    if (assign_least_loaded == _assign_policy)
+    {
+        std::vector<uint32_t> loads(_loop_array.size());
+        for (std::vector<CEventLoop*>::size_type i=0; i<_loop_array.size(); ++i)
+            loads[i] = _loop_array[i]->get_epollable_number();
+        for (uint32_t k=0; k<number; ++k)
+        {
+            const std::vector<uint32_t>::size_type i = std::min_element(loads.begin(), loads.end()) - loads.begin();
+            groups[i].push_back(epollables[k]);
+            ++loads[i];
+        }
+    }
+    else
+    {
+        const uint32_t next = __atomic_fetch_add(&_next_loop, number, __ATOMIC_RELAXED);
+        for (uint32_t k=0; k<number; ++k)
+            groups[(next + k) % _loop_array.size()].push_back(epollables[k]);
+    }
+
+    for (std::vector<CEventLoop*>::size_type i=0; i<_loop_array.size(); ++i)
+    {
+        if (!groups[i].empty())
+            _loop_array[i]->post_add(&groups[i][0], static_cast<uint32_t>(groups[i].size()), events);
+    }
+}
+
+NET_NAMESPACE_END
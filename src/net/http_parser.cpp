@@ -0,0 +1,380 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/http_parser.h"
+#include <string.h>
+#include <strings.h>
+NET_NAMESPACE_BEGIN
+
+// 不区分大小写比较
+static bool equal_ignore_case(std::string_view a, std::string_view b)
+{
+    return (a.size() == b.size()) && (0 == strncasecmp(a.data(), b.data(), a.size()));
+}
+
+// 逗号分隔的值中是否有token，如Connection: keep-alive, Upgrade
+static bool has_token(std::string_view value, std::string_view token)
+{
+    while (!value.empty())
+    {
+        std::string_view::size_type comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && ((' ' == item.front()) || ('\t' == item.front())))
+            item.remove_prefix(1);
+        while (!item.empty() && ((' ' == item.back()) || ('\t' == item.back())))
+            item.remove_suffix(1);
+        if (equal_ignore_case(item, token))
+            return true;
+        if (std::string_view::npos == comma)
+            break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+// RFC 7230中的tchar
+static bool is_token_char(char c)
+{
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9'))
+        || ((c != '\0') && (strchr("!#$%&'*+-.^_`|~", c) != NULL));
+}
+
+CHttpRequest::CHttpRequest()
+    : _minor_version(1), _keep_alive(true), _chunked(false), _header_number(0)
+{
+}
+
+std::string_view CHttpRequest::get_header(std::string_view name) const
+{
+    for (int i=0; i<_header_number; ++i)
+    {
+        if (equal_ignore_case(_headers[i].name, name))
+            return _headers[i].value;
+    }
+    return std::string_view();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CHttpRequestParser::CHttpRequestParser(size_t header_size_max, size_t body_size_max)
+    : _header_size_max(header_size_max), _body_size_max(body_size_max)
+{
+    reset();
+}
+
+void CHttpRequestParser::set_limits(size_t header_size_max, size_t body_size_max)
+{
+    _header_size_max = header_size_max;
+    _body_size_max = body_size_max;
+}
+
+void CHttpRequestParser::reset()
+{
+    _scanned = 0;
+    _header_size = 0;
+    _content_length = 0;
+    _error_status = 0;
+}
+
+ssize_t CHttpRequestParser::fail(int status)
+{
+    _error_status = status;
+    return -1;
+}
+
+ssize_t CHttpRequestParser::parse(char* buffer, size_t size, CHttpRequest* request)
+{
+    if (0 == _header_size)
+    {
+        // 从上次扫描过的位置继续找空行，回退3个字节以免\r\n\r\n被分在两次之间
+        const size_t from = (_scanned > 3)? _scanned-3: 0;
+        const char* end = static_cast<const char*>(memmem(buffer+from, size-from, "\r\n\r\n", 4));
+        if (NULL == end)
+        {
+            _scanned = size;
+            return (size > _header_size_max)? fail(431): 0;
+        }
+
+        _header_size = static_cast<size_t>(end - buffer) + 4;
+        if (_header_size > _header_size_max)
+            return fail(431);
+        if (!parse_header(buffer, request))
+            return -1;
+
+        // 头部中有Content-Length和Transfer-Encoding，已在parse_header中检查
+        _content_length = request->_body.size();
+        if (!request->_chunked && (_content_length > _body_size_max))
+            return fail(413);
+    }
+    else
+    {
+        // 缓冲区可能已被调用者移动，需重新解析头部以更新各字段
+        if (!parse_header(buffer, request))
+            return -1;
+    }
+
+    ssize_t consumed;
+    if (request->_chunked)
+    {
+        size_t body_size = 0;
+        const ssize_t bytes = decode_chunked(buffer+_header_size, size-_header_size, &body_size);
+        if (bytes <= 0)
+            return bytes;
+        request->_body = std::string_view(buffer+_header_size, body_size);
+        consumed = static_cast<ssize_t>(_header_size) + bytes;
+    }
+    else
+    {
+        if (size < _header_size + _content_length)
+            return 0;
+        request->_body = std::string_view(buffer+_header_size, _content_length);
+        consumed = static_cast<ssize_t>(_header_size + _content_length);
+    }
+
+    reset();
+    return consumed;
+}
+
+bool CHttpRequestParser::parse_header(char* buffer, CHttpRequest* request)
+{
+    const char* p = buffer;
+    const char* end = buffer + _header_size - 2; // 最后一个头部行的\r\n之后
+
+    // 请求行：方法 SP 目标 SP HTTP/1.x CRLF，容忍请求之前多余的空行
+    while ((p+1 < end) && ('\r' == p[0]) && ('\n' == p[1]))
+        p += 2;
+    const char* method = p;
+    while ((p < end) && is_token_char(*p))
+        ++p;
+    if ((p == method) || (p >= end) || (*p != ' '))
+    {
+        _error_status = 400;
+        return false;
+    }
+    request->_method = std::string_view(method, p-method);
+
+    const char* target = ++p;
+    while ((p < end) && (*p != ' ') && (*p != '\r'))
+    {
+        if (static_cast<unsigned char>(*p) <= 0x20)
+        {
+            _error_status = 400;
+            return false;
+        }
+        ++p;
+    }
+    if ((p == target) || (p >= end) || (*p != ' '))
+    {
+        _error_status = 400;
+        return false;
+    }
+    request->_target = std::string_view(target, p-target);
+    const std::string_view::size_type question = request->_target.find('?');
+    request->_path = request->_target.substr(0, question);
+    request->_query = (std::string_view::npos == question)? std::string_view(): request->_target.substr(question+1);
+
+    ++p;
+    if ((end - p < 10) || (memcmp(p, "HTTP/1.", 7) != 0) || (p[7] < '0') || (p[7] > '9') || (p[8] != '\r') || (p[9] != '\n'))
+    {
+        _error_status = ((end - p >= 5) && (0 == memcmp(p, "HTTP/", 5)))? 505: 400;
+        return false;
+    }
+    request->_minor_version = p[7] - '0';
+    p += 10;
+
+    // 头部：名字: OWS 值 OWS CRLF
+    bool has_content_length = false;
+    bool has_transfer_encoding = false;
+    bool keep_alive = request->_minor_version >= 1;
+    size_t content_length = 0;
+    request->_header_number = 0;
+    request->_chunked = false;
+    while (p < end)
+    {
+        const char* line_end = static_cast<const char*>(memchr(p, '\r', end-p));
+        if ((NULL == line_end) || (line_end[1] != '\n'))
+        {
+            _error_status = 400;
+            return false;
+        }
+
+        const char* name = p;
+        while ((p < line_end) && is_token_char(*p))
+            ++p;
+        // 不支持已废弃的折行（obs-fold），名字和冒号之间也不能有空白
+        if ((p == name) || (p >= line_end) || (*p != ':'))
+        {
+            _error_status = 400;
+            return false;
+        }
+        if (HTTP_HEADER_MAX == request->_header_number)
+        {
+            _error_status = 431;
+            return false;
+        }
+
+        const std::string_view header_name(name, p-name);
+        const char* value = p + 1;
+        const char* value_end = line_end;
+        while ((value < value_end) && ((' ' == *value) || ('\t' == *value)))
+            ++value;
+        while ((value_end > value) && ((' ' == value_end[-1]) || ('\t' == value_end[-1])))
+            --value_end;
+        const std::string_view header_value(value, value_end-value);
+
+        CHttpRequest::Header& header = request->_headers[request->_header_number++];
+        header.name = header_name;
+        header.value = header_value;
+
+        if (equal_ignore_case(header_name, "Content-Length"))
+        {
+            // 多个不同的Content-Length为错误
+            size_t length = 0;
+            if (header_value.empty() || (header_value.size() > 18))
+            {
+                _error_status = 400;
+                return false;
+            }
+            for (std::string_view::size_type i=0; i<header_value.size(); ++i)
+            {
+                if ((header_value[i] < '0') || (header_value[i] > '9'))
+                {
+                    _error_status = 400;
+                    return false;
+                }
+                length = length * 10 + (header_value[i] - '0');
+            }
+            if (has_content_length && (length != content_length))
+            {
+                _error_status = 400;
+                return false;
+            }
+            has_content_length = true;
+            content_length = length;
+        }
+        else if (equal_ignore_case(header_name, "Transfer-Encoding"))
+        {
+            // 只支持chunked，且必须是最后一个编码
+            has_transfer_encoding = true;
+            if (!equal_ignore_case(header_value, "chunked"))
+            {
+                _error_status = 501;
+                return false;
+            }
+            request->_chunked = true;
+        }
+        else if (equal_ignore_case(header_name, "Connection"))
+        {
+            if (has_token(header_value, "close"))
+                keep_alive = false;
+            else if (has_token(header_value, "keep-alive"))
+                keep_alive = true;
+        }
+
+        p = line_end + 2;
+    }
+
+    if (has_content_length && has_transfer_encoding)
+    {
+        _error_status = 400;
+        return false;
+    }
+
+    request->_keep_alive = keep_alive;
+    request->_body = std::string_view(buffer+_header_size, content_length);
+    return true;
+}
+
+// 先扫描确认完整，再就地去掉各块的长度行，返回分块编码占用的字节数
+ssize_t CHttpRequestParser::decode_chunked(char* body, size_t size, size_t* body_size)
+{
+    size_t offset = 0;
+    size_t decoded_size = 0;
+    size_t chunk_number = 0;
+
+    for (;;)
+    {
+        // 块长度行：十六进制长度[;扩展]CRLF
+        const char* line_end = static_cast<const char*>(memmem(body+offset, size-offset, "\r\n", 2));
+        if (NULL == line_end)
+            return (size - offset > 1024)? fail(400): 0;
+
+        size_t chunk_size = 0;
+        const char* p = body + offset;
+        if (p == line_end)
+            return fail(400);
+        for (; (p < line_end) && (*p != ';'); ++p)
+        {
+            int digit;
+            if ((*p >= '0') && (*p <= '9'))
+                digit = *p - '0';
+            else if ((*p >= 'a') && (*p <= 'f'))
+                digit = *p - 'a' + 10;
+            else if ((*p >= 'A') && (*p <= 'F'))
+                digit = *p - 'A' + 10;
+            else
+                return fail(400);
+            if (chunk_size > (_body_size_max >> 4))
+                return fail(413);
+            chunk_size = (chunk_size << 4) | digit;
+        }
+
+        offset = static_cast<size_t>(line_end - body) + 2;
+        if (0 == chunk_size)
+            break;
+
+        decoded_size += chunk_size;
+        if (decoded_size > _body_size_max)
+            return fail(413);
+        if (size - offset < chunk_size + 2)
+            return 0;
+        if ((body[offset+chunk_size] != '\r') || (body[offset+chunk_size+1] != '\n'))
+            return fail(400);
+        offset += chunk_size + 2;
+        ++chunk_number;
+    }
+
+    // 尾部头部（trailer），直到空行，忽略其内容
+    for (;;)
+    {
+        const char* line_end = static_cast<const char*>(memmem(body+offset, size-offset, "\r\n", 2));
+        if (NULL == line_end)
+            return (size - offset > 1024)? fail(400): 0;
+        const size_t line_size = static_cast<size_t>(line_end - (body + offset));
+        offset += line_size + 2;
+        if (0 == line_size)
+            break;
+    }
+
+    // 完整了，将各块的数据依次移到消息体的开头
+    size_t from = 0;
+    size_t to = 0;
+    for (size_t i=0; i<chunk_number; ++i)
+    {
+        const char* line_end = static_cast<const char*>(memmem(body+from, size-from, "\r\n", 2));
+        const size_t chunk_size = strtoul(body+from, NULL, 16);
+        from = static_cast<size_t>(line_end - body) + 2;
+        memmove(body+to, body+from, chunk_size);
+        to += chunk_size;
+        from += chunk_size + 2;
+    }
+
+    *body_size = decoded_size;
+    return static_cast<ssize_t>(offset);
+}
+
+NET_NAMESPACE_END
@@ -0,0 +1,819 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/http_server.h"
+#include "net/recv_buffer.h"
+#include "sys/event.h"
+#include "sys/lock.h"
+#include "sys/log.h"
+#include "sys/utils.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <set>
+#include <time.h>
+NET_NAMESPACE_BEGIN
+
+// 接收缓冲区的最小级别和最大的池化级别，更大的从堆上分配
+#define HTTP_RECV_SIZE_MIN  4096
+#define HTTP_RECV_POOL_MAX  32768
+// 接收缓冲区池每个级别预先分配的块数
+#define HTTP_RECV_POOL_BUCKETS 16
+
+// 待发送的应答超过这么多字节时，暂停处理后续的流水线请求，直到发送出去
+#define HTTP_OUTPUT_HIGH_WATER (256*1024)
+
+// 分块应答缓冲超过这么多字节时尝试发送
+#define HTTP_CHUNK_FLUSH_SIZE (64*1024)
+
+// 一次可读事件最多accept的批数
+#define HTTP_ACCEPT_BATCHES 4
+
+// 检查空闲连接的间隔毫秒数
+#define HTTP_SWEEP_MILLISECONDS 1000
+
+static sys::CCounter* get_requests_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("http.requests");
+    return counter;
+}
+
+static sys::CCounter* get_bad_requests_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("http.bad_requests");
+    return counter;
+}
+
+static sys::CCounter* get_not_found_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("http.not_found");
+    return counter;
+}
+
+static sys::CGauge* get_connections_gauge()
+{
+    static sys::CGauge* gauge = sys::CMetricsRegistry::get_singleton()->get_gauge("http.connections");
+    return gauge;
+}
+
+// 每秒格式化一次的Date头部
+static const std::string_view& get_date_header()
+{
+    static thread_local time_t last_time = 0;
+    static thread_local char date[64];
+    static thread_local std::string_view date_header;
+
+    const time_t now = time(NULL);
+    if (now != last_time)
+    {
+        struct tm result;
+        (void)gmtime_r(&now, &result);
+        const size_t length = strftime(date, sizeof(date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &result);
+        date_header = std::string_view(date, length);
+        last_time = now;
+    }
+    return date_header;
+}
+
+static void append_number(std::string* output, uint64_t number, int base)
+{
+    char digits[24];
+    int n = sizeof(digits);
+    do
+    {
+        digits[--n] = "0123456789abcdef"[number % base];
+        number /= base;
+    } while (number > 0);
+    output->append(digits+n, sizeof(digits)-n);
+}
+
+/***
+  * 一个HTTP连接，在所属的事件循环中收请求、处理和发应答
+  */
+class CHttpConnection: public CEpollable
+{
+public:
+    CHttpConnection(int fd, CHttpServer* server, CHttpServer::LoopContext* context);
+
+    std::string* get_output() { return &_output; }
+    uint64_t get_active_milliseconds() const { return _active_milliseconds; }
+
+    /** 尽量发送，不能全部发送时缓冲着等可写事件 */
+    void try_flush() { (void)flush(); }
+
+private:
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+    virtual void before_close();
+    bool receive(uint32_t budget_bytes);
+    bool process(uint32_t budget_messages);
+    bool flush();
+    void respond_error(int status_code);
+
+private:
+    CHttpServer* _server;
+    CHttpServer::LoopContext* _context;
+    uint64_t _active_milliseconds;
+    CRecvBuffer _input;    /** 请求处理完后释放，空闲的连接不占用接收缓冲区 */
+    std::string _output;
+    size_t _output_offset; /** 已发送的字节数 */
+    bool _closing;         /** 发完应答后关闭 */
+    bool _peer_closed;     /** 对端已关闭写方向 */
+    bool _broken;          /** 连接出错 */
+    CHttpRequestParser _parser;
+    CHttpRequest _request;
+    CHttpResponse _response;
+};
+
+// 每个事件循环的监听分片，accept到的连接交给本循环
+class CHttpListener: public CListener
+{
+public:
+    CHttpListener(): _server(NULL), _context(NULL) {}
+
+    void attach(CHttpServer* server, CHttpServer::LoopContext* context)
+    {
+        _server = server;
+        _context = context;
+    }
+
+private:
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    CHttpServer* _server;
+    CHttpServer::LoopContext* _context;
+};
+
+struct CHttpServer::LoopContext: public ITimerHandler
+{
+    CHttpServer* server;
+    CEventLoop* event_loop;
+    CHttpListener* listener;
+    uint64_t timer_id;
+    std::set<CHttpConnection*> connections;
+    sys::CSlabMemPool recv_pool; /** 本循环所有连接的接收缓冲区 */
+
+    // 关闭空闲的连接
+    virtual uint32_t on_timer(CEventLoop* loop, uint64_t id)
+    {
+        const uint32_t idle_milliseconds = server->get_idle_timeout();
+        if (idle_milliseconds > 0)
+        {
+            const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+            std::vector<CHttpConnection*> idle_connections;
+            for (std::set<CHttpConnection*>::iterator iter=connections.begin(); iter!=connections.end(); ++iter)
+            {
+                if (now - (*iter)->get_active_milliseconds() >= idle_milliseconds)
+                    idle_connections.push_back(*iter);
+            }
+            for (std::vector<CHttpConnection*>::size_type i=0; i<idle_connections.size(); ++i)
+                loop->remove(idle_connections[i], true);
+        }
+        return HTTP_SWEEP_MILLISECONDS;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+CHttpResponse::CHttpResponse()
+    : _connection(NULL), _status_code(200), _reason_phrase(NULL), _minor_version(1),
+      _keep_alive(true), _is_head(false), _close(false), _chunked(false)
+{
+}
+
+void CHttpResponse::set_status(int status_code, const char* reason_phrase)
+{
+    _status_code = status_code;
+    _reason_phrase = reason_phrase;
+}
+
+void CHttpResponse::add_header(std::string_view name, std::string_view value)
+{
+    _headers.append(name);
+    _headers.append(": ", 2);
+    _headers.append(value);
+    _headers.append("\r\n", 2);
+}
+
+void CHttpResponse::append(std::string_view data)
+{
+    if (_chunked)
+        write_chunk(data);
+    else
+        _body.append(data);
+}
+
+void CHttpResponse::begin_chunked()
+{
+    if (_chunked)
+        return;
+
+    // HTTP/1.0不支持分块编码，以关闭连接表示应答结束
+    if (0 == _minor_version)
+        _close = true;
+    serialize_header(_connection->get_output(), NULL);
+    _chunked = true;
+
+    if (!_body.empty())
+    {
+        std::string body;
+        body.swap(_body);
+        write_chunk(body);
+    }
+}
+
+void CHttpResponse::write_chunk(std::string_view data)
+{
+    if (data.empty() || _is_head)
+        return;
+
+    std::string* output = _connection->get_output();
+    if (0 == _minor_version)
+    {
+        output->append(data);
+    }
+    else
+    {
+        append_number(output, data.size(), 16);
+        output->append("\r\n", 2);
+        output->append(data);
+        output->append("\r\n", 2);
+    }
+
+    if (output->size() >= HTTP_CHUNK_FLUSH_SIZE)
+        _connection->try_flush();
+}
+
+void CHttpResponse::reset(CHttpConnection* connection, int minor_version, bool keep_alive, bool is_head)
+{
+    _connection = connection;
+    _status_code = 200;
+    _reason_phrase = NULL;
+    _minor_version = minor_version;
+    _keep_alive = keep_alive;
+    _is_head = is_head;
+    _close = false;
+    _chunked = false;
+    _headers.clear();
+    _body.clear();
+}
+
+void CHttpResponse::serialize_header(std::string* output, const std::string_view* content_length)
+{
+    const char* reason_phrase = (NULL == _reason_phrase)? get_reason_phrase(_status_code): _reason_phrase;
+    output->append((0 == _minor_version)? "HTTP/1.0 ": "HTTP/1.1 ", 9);
+    append_number(output, _status_code, 10);
+    output->push_back(' ');
+    output->append(reason_phrase);
+    output->append("\r\n", 2);
+    output->append(get_date_header());
+    output->append(_headers);
+
+    if (content_length != NULL)
+    {
+        output->append("Content-Length: ", 16);
+        output->append(*content_length);
+        output->append("\r\n", 2);
+    }
+    else if (_minor_version > 0)
+    {
+        output->append("Transfer-Encoding: chunked\r\n", 28);
+    }
+
+    if (!_keep_alive || _close)
+        output->append("Connection: close\r\n", 19);
+    else if (0 == _minor_version)
+        output->append("Connection: keep-alive\r\n", 24);
+    output->append("\r\n", 2);
+}
+
+void CHttpResponse::finish()
+{
+    std::string* output = _connection->get_output();
+    if (_chunked)
+    {
+        if (!_is_head && (_minor_version > 0))
+            output->append("0\r\n\r\n", 5);
+    }
+    else
+    {
+        char digits[24];
+        const int length = snprintf(digits, sizeof(digits), "%zu", _body.size());
+        const std::string_view content_length(digits, length);
+        serialize_header(output, &content_length);
+        if (!_is_head)
+            output->append(_body);
+    }
+}
+
+const char* CHttpResponse::get_reason_phrase(int status_code)
+{
+    switch (status_code)
+    {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 415: return "Unsupported Media Type";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    case 505: return "HTTP Version Not Supported";
+    default:  return "Unknown";
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CHttpConnection::CHttpConnection(int fd, CHttpServer* server, CHttpServer::LoopContext* context)
+    : _server(server), _context(context), _active_milliseconds(CEventLoop::get_monotonic_milliseconds()),
+      _input(HTTP_RECV_SIZE_MIN, &context->recv_pool), _output_offset(0), _closing(false), _peer_closed(false), _broken(false),
+      _parser(server->get_header_size_max(), server->get_body_size_max())
+{
+    set_fd(fd);
+    _context->connections.insert(this);
+    get_connections_gauge()->add(1);
+}
+
+void CHttpConnection::before_close()
+{
+    _context->connections.erase(this);
+    get_connections_gauge()->add(-1);
+}
+
+epoll_event_t CHttpConnection::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    const CIoBudget budget = static_cast<CEventLoop*>(input_ptr)->get_io_budget(this);
+    bool exhausted = false;
+    _active_milliseconds = CEventLoop::get_monotonic_milliseconds();
+
+    // 先发完之前积压的应答
+    if (!flush())
+        return _broken? epoll_close: epoll_write;
+    if (_closing)
+        return epoll_close;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        exhausted = receive(budget.bytes);
+    if (_broken)
+        return epoll_close;
+
+    // 对端关闭写方向后，仍处理已收到的请求
+    if (process(budget.messages))
+        exhausted = true;
+    if (!flush())
+        return _broken? epoll_close: epoll_write;
+    if (_closing)
+        return epoll_close;
+    // 预算用完时先处理完已收到的请求，再关闭
+    if (exhausted)
+        return epoll_again;
+    if (_peer_closed)
+        return epoll_close;
+    return epoll_read;
+}
+
+// 返回是否因预算用完而停止，这时内核中可能还有数据
+bool CHttpConnection::receive(uint32_t budget_bytes)
+{
+    size_t received_bytes = 0;
+
+    for (;;)
+    {
+        if ((budget_bytes > 0) && (received_bytes >= budget_bytes))
+            return true;
+
+        // 解析器记住的是相对于请求开头的位置，缓冲区增长或缩小时移动数据不影响解析
+        size_t space = _input.get_read_space();
+        if ((budget_bytes > 0) && (space > budget_bytes - received_bytes))
+            space = budget_bytes - received_bytes;
+        const ssize_t bytes = _input.read_fd(get_fd(), space);
+        if (bytes > 0)
+        {
+            received_bytes += static_cast<size_t>(bytes);
+            // 没有收满，说明内核中的数据已收完
+            if (static_cast<size_t>(bytes) < space)
+                break;
+            // 未处理的数据过多（请求还不完整），交给解析器判断是否超限
+            if (_input.size() > _server->get_header_size_max() + _server->get_body_size_max())
+                break;
+        }
+        else if (0 == bytes)
+        {
+            _peer_closed = true;
+            break;
+        }
+        else if (EINTR != errno)
+        {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                _broken = true;
+            break;
+        }
+    }
+
+    return false;
+}
+
+// 返回是否因预算用完而停止，这时可能还有未处理的请求
+bool CHttpConnection::process(uint32_t budget_messages)
+{
+    uint32_t processed_number = 0;
+
+    while (!_closing && !_input.empty() && (_output.size() - _output_offset < HTTP_OUTPUT_HIGH_WATER))
+    {
+        if ((budget_messages > 0) && (processed_number >= budget_messages))
+            return true;
+
+        const ssize_t bytes = _parser.parse(_input.data(), _input.size(), &_request);
+        if (0 == bytes)
+        {
+            break;
+        }
+        if (bytes < 0)
+        {
+            _server->on_bad_request();
+            respond_error(_parser.get_error_status());
+            break;
+        }
+
+        const bool is_head = ("HEAD" == _request.get_method());
+        _response.reset(this, _request.get_minor_version(), _request.is_keep_alive(), is_head);
+        _server->dispatch(_request, &_response);
+        _response.finish();
+
+        _input.drain(static_cast<size_t>(bytes));
+        ++processed_number;
+        if (!_request.is_keep_alive() || _response._close)
+            _closing = true;
+    }
+
+    return false;
+}
+
+void CHttpConnection::respond_error(int status_code)
+{
+    _response.reset(this, 1, false, false);
+    _response.set_status(status_code);
+    _response.set_content_type("text/plain");
+    _response.append(CHttpResponse::get_reason_phrase(status_code));
+    _response.append("\n");
+    _response.finish();
+    _closing = true;
+}
+
+bool CHttpConnection::flush()
+{
+    while (_output_offset < _output.size())
+    {
+        const ssize_t bytes = ::send(get_fd(), _output.data()+_output_offset, _output.size()-_output_offset, MSG_NOSIGNAL);
+        if (bytes >= 0)
+        {
+            _output_offset += static_cast<size_t>(bytes);
+        }
+        else if (EINTR != errno)
+        {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                _broken = true;
+            return false;
+        }
+    }
+
+    // 较大的应答发送后释放其内存，否则保留以便复用
+    if (_output.capacity() > HTTP_OUTPUT_HIGH_WATER * 4)
+        std::string().swap(_output);
+    else
+        _output.clear();
+    _output_offset = 0;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+epoll_event_t CHttpListener::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    CEventLoop* event_loop = static_cast<CEventLoop*>(input_ptr);
+    accepted_t accepted_array[64];
+
+    try
+    {
+        for (int k=0; k<HTTP_ACCEPT_BATCHES; ++k)
+        {
+            const int number = accept_batch(accepted_array, sizeof(accepted_array)/sizeof(accepted_array[0]));
+            for (int i=0; i<number; ++i)
+            {
+                net::set_nodelay(accepted_array[i].fd, true);
+                CHttpConnection* connection = new CHttpConnection(accepted_array[i].fd, _server, _context);
+                try
+                {
+                    event_loop->add(connection, EPOLLIN);
+                }
+                catch (sys::CSyscallException& ex)
+                {
+                    MYLOG_ERROR("loop[%d] add http connection error: %s\n", event_loop->get_index(), ex.str().c_str());
+                    connection->close();
+                    delete connection;
+                }
+            }
+            if (number < static_cast<int>(sizeof(accepted_array)/sizeof(accepted_array[0])))
+                break;
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        // 如文件句柄用完，监听者本身仍然有效
+        MYLOG_ERROR("loop[%d] http accept error: %s\n", event_loop->get_index(), ex.str().c_str());
+    }
+
+    return epoll_none;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 在循环线程中开始监听和定时检查空闲连接
+class CHttpStartTask: public ILoopTask
+{
+public:
+    CHttpStartTask(CHttpServer::LoopContext* context)
+        : _context(context)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        const CIoBudget& io_budget = _context->server->get_io_budget();
+        event_loop->set_io_budget(io_budget.bytes, io_budget.messages);
+        event_loop->add(_context->listener, EPOLLIN);
+        _context->timer_id = event_loop->run_after(HTTP_SWEEP_MILLISECONDS, _context);
+    }
+
+private:
+    CHttpServer::LoopContext* _context;
+};
+
+// 在循环线程中停止监听并关闭所有连接
+class CHttpStopTask: public ILoopTask
+{
+public:
+    CHttpStopTask(CHttpServer::LoopContext* context, sys::CLock* lock, sys::CEvent* event, int* stopped_number)
+        : _context(context), _lock(lock), _event(event), _stopped_number(stopped_number)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        (void)event_loop->cancel_timer(_context->timer_id);
+        if (_context->listener->get_epoll_events() != -1)
+            event_loop->remove(_context->listener, false);
+
+        std::vector<CHttpConnection*> connections(_context->connections.begin(), _context->connections.end());
+        for (std::vector<CHttpConnection*>::size_type i=0; i<connections.size(); ++i)
+            event_loop->remove(connections[i], true);
+
+        sys::LockHelper<sys::CLock> lock_helper(*_lock);
+        ++*_stopped_number;
+        _event->signal();
+    }
+
+private:
+    CHttpServer::LoopContext* _context;
+    sys::CLock* _lock;
+    sys::CEvent* _event;
+    int* _stopped_number;
+};
+
+CHttpServer::CHttpServer()
+    : _idle_milliseconds(60000), _header_size_max(8192), _body_size_max(1048576), _port(0), _request_number(0),
+      _listen_manager(NULL)
+{
+}
+
+CHttpServer::~CHttpServer()
+{
+    stop();
+}
+
+void CHttpServer::add_route(const std::string& method, const std::string& path, IHttpHandler* handler)
+{
+    Route route;
+    const bool is_prefix = !path.empty() && ('*' == path[path.size()-1]);
+    route.method = method;
+    route.path = is_prefix? path.substr(0, path.size()-1): path;
+    route.handler = handler;
+    route.requests = sys::CMetricsRegistry::get_singleton()->get_counter("http.route." + route.path + ".requests");
+    route.latency = sys::CMetricsRegistry::get_singleton()->get_histogram("http.route." + route.path + ".latency_ns");
+
+    if (!is_prefix)
+    {
+        _exact_routes[route.path].push_back(route);
+    }
+    else
+    {
+        _prefix_routes.push_back(route);
+        std::stable_sort(_prefix_routes.begin(), _prefix_routes.end(),
+                         [](const Route& a, const Route& b) { return a.path.size() > b.path.size(); });
+    }
+}
+
+void CHttpServer::set_limits(size_t header_size_max, size_t body_size_max)
+{
+    _header_size_max = header_size_max;
+    _body_size_max = body_size_max;
+}
+
+void CHttpServer::start(const ip_address_t& ip, uint16_t port, uint16_t reactor_number, bool pin_cpu)
+{
+    if (0 == reactor_number)
+        reactor_number = sys::CUtils::get_cpu_number();
+    if (0 == reactor_number)
+        reactor_number = 1;
+
+    try
+    {
+        // 多个分片时先以SO_REUSEPORT占住系统分配的端口，使各分片监听同一端口
+        CListener probe;
+        if ((0 == port) && (reactor_number > 1))
+        {
+            struct sockaddr_storage addr;
+            socklen_t addr_len = sizeof(addr);
+            probe.listen(ip, 0, true, false, true);
+            if (-1 == getsockname(probe.get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "getsockname");
+            port = ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+        }
+
+        _reactor_pool.create(reactor_number, 10000, pin_cpu);
+        _listen_manager = new CListenManager<CHttpListener>;
+        _listen_manager->add(ip, port);
+        _listen_manager->create(true, reactor_number);
+        probe.close();
+
+        if (0 == port)
+        {
+            struct sockaddr_storage addr;
+            socklen_t addr_len = sizeof(addr);
+            if (-1 == getsockname(_listen_manager->get_listener(0, 0)->get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "getsockname");
+            port = ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+        }
+        _port = port;
+
+        for (uint16_t i=0; i<reactor_number; ++i)
+        {
+            LoopContext* context = new LoopContext;
+            context->event_loop = _reactor_pool.get_loop(i);
+            context->listener = _listen_manager->get_listener(0, i);
+            context->server = this;
+            context->timer_id = 0;
+            context->recv_pool.create(HTTP_RECV_SIZE_MIN, HTTP_RECV_POOL_MAX, 100, HTTP_RECV_POOL_BUCKETS);
+            _loop_contexts.push_back(context);
+
+            // 监听者属于CListenManager的数组，保持一个引用，使事件循环剔除它时不会将其销毁
+            context->listener->inc_refcount();
+            context->listener->attach(this, context);
+            context->event_loop->post(new CHttpStartTask(context));
+        }
+    }
+    catch (...)
+    {
+        stop();
+        throw;
+    }
+}
+
+void CHttpServer::stop()
+{
+    sys::CLock lock;
+    sys::CEvent event;
+    int stopped_number = 0;
+
+    for (std::vector<LoopContext*>::size_type i=0; i<_loop_contexts.size(); ++i)
+        _loop_contexts[i]->event_loop->post(new CHttpStopTask(_loop_contexts[i], &lock, &event, &stopped_number));
+    {
+        sys::LockHelper<sys::CLock> lock_helper(lock);
+        while (stopped_number < static_cast<int>(_loop_contexts.size()))
+            event.wait(lock);
+    }
+
+    _reactor_pool.destroy();
+    if (_listen_manager != NULL)
+    {
+        _listen_manager->destroy();
+        delete _listen_manager;
+        _listen_manager = NULL;
+    }
+    for (std::vector<LoopContext*>::size_type i=0; i<_loop_contexts.size(); ++i)
+        delete _loop_contexts[i];
+    _loop_contexts.clear();
+}
+
+void CHttpServer::on_bad_request() const
+{
+    get_bad_requests_counter()->inc();
+}
+
+const CHttpServer::Route* CHttpServer::find_route(std::string_view method, std::string_view path, bool* method_mismatch) const
+{
+    *method_mismatch = false;
+    const bool is_head = ("HEAD" == method);
+
+    std::map<std::string, std::vector<Route>, std::less<> >::const_iterator iter = _exact_routes.find(path);
+    if (iter != _exact_routes.end())
+    {
+        for (std::vector<Route>::size_type i=0; i<iter->second.size(); ++i)
+        {
+            const Route& route = iter->second[i];
+            if (route.method.empty() || (route.method == method) || (is_head && ("GET" == route.method)))
+                return &route;
+        }
+        *method_mismatch = true;
+    }
+
+    for (std::vector<Route>::size_type i=0; i<_prefix_routes.size(); ++i)
+    {
+        const Route& route = _prefix_routes[i];
+        if (0 == path.compare(0, route.path.size(), route.path))
+        {
+            if (route.method.empty() || (route.method == method) || (is_head && ("GET" == route.method)))
+                return &route;
+            *method_mismatch = true;
+        }
+    }
+
+    return NULL;
+}
+
+void CHttpServer::dispatch(const CHttpRequest& request, CHttpResponse* response)
+{
+    __atomic_add_fetch(&_request_number, 1, __ATOMIC_RELAXED);
+    get_requests_counter()->inc();
+
+    bool method_mismatch;
+    const Route* route = find_route(request.get_method(), request.get_path(), &method_mismatch);
+    if (NULL == route)
+    {
+        const int status_code = method_mismatch? 405: 404;
+        if (404 == status_code)
+            get_not_found_counter()->inc();
+        response->set_status(status_code);
+        response->set_content_type("text/plain");
+        response->append(CHttpResponse::get_reason_phrase(status_code));
+        response->append("\n");
+        return;
+    }
+
+    route->requests->inc();
+    sys::CLatencyRecorder latency_recorder(route->latency);
+    try
+    {
+        route->handler->handle(request, response);
+    }
+    catch (std::exception& ex)
+    {
+        // 已开始分块应答时不能再改状态码，只能关闭连接
+        MYLOG_ERROR("http handler of %s error: %s\n", route->path.c_str(), ex.what());
+        if (!response->_chunked)
+        {
+            response->_headers.clear();
+            response->_body.clear();
+            response->set_status(500);
+        }
+        response->set_close();
+    }
+}
+
+NET_NAMESPACE_END
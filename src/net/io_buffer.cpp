@@ -0,0 +1,418 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/io_buffer.h"
+#include <mooon/sys/mem_tracker.h>
+#include <algorithm>
+#include <string.h>
+NET_NAMESPACE_BEGIN
+
+// 从堆上分配的块，从块池分配的由池的统计计入
+static sys::CMemTracker* get_mem_tracker()
+{
+    static sys::CMemTracker* tracker = sys::CMemTracker::get_tracker("io_buffer");
+    return tracker;
+}
+
+CIoBuffer::CIoBuffer(size_t block_size, sys::CRawMemPool* block_pool)
+    : _block_pool(block_pool), _size(0), _spare_block(NULL), _read_into_tail(false)
+{
+    // 块头在池块的开头，池块大小（含警戒字节）不是8的倍数时块头不能对齐，不使用池
+    if ((block_pool != NULL) && ((0 != block_pool->get_bucket_size() % 8) || (static_cast<size_t>(block_pool->get_bucket_size()) <= static_cast<size_t>(block_pool->get_guard_size()) + sizeof(Block))))
+        _block_pool = NULL;
+    if (NULL == _block_pool)
+        _block_size = static_cast<uint32_t>(std::max(block_size, static_cast<size_t>(64)));
+    else
+        _block_size = static_cast<uint32_t>(_block_pool->get_bucket_size() - _block_pool->get_guard_size() - sizeof(Block));
+}
+
+CIoBuffer::~CIoBuffer()
+{
+    clear();
+    if (_spare_block != NULL)
+        unref_block(_spare_block);
+}
+
+const char* CIoBuffer::get_slice(size_t index, size_t* size) const
+{
+    const Slice& slice = _slices[index];
+    *size = slice.end - slice.begin;
+    return slice.block->data + slice.begin;
+}
+
+void CIoBuffer::append(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        if (_slices.empty() || !is_writable(_slices.back()) || (_slices.back().end == _slices.back().block->capacity))
+        {
+            Slice slice;
+            slice.block = allocate_block();
+            slice.begin = 0;
+            slice.end = 0;
+            _slices.push_back(slice);
+        }
+
+        Slice& tail = _slices.back();
+        const size_t bytes = std::min(size, static_cast<size_t>(tail.block->capacity - tail.end));
+        memcpy(tail.block->data + tail.end, data, bytes);
+        tail.end += static_cast<uint32_t>(bytes);
+        _size += bytes;
+        data += bytes;
+        size -= bytes;
+    }
+}
+
+void CIoBuffer::append(CIoBuffer* other)
+{
+    _slices.insert(_slices.end(), other->_slices.begin(), other->_slices.end());
+    _size += other->_size;
+    other->_slices.clear();
+    other->_size = 0;
+}
+
+void CIoBuffer::append_external(const char* data, size_t size, io_release_t release, void* context)
+{
+    if (0 == size)
+    {
+        if (release != NULL)
+            (*release)(data, size, context);
+        return;
+    }
+
+    Block* block = new Block;
+    block->refcount = 1;
+    block->capacity = static_cast<uint32_t>(size);
+    block->data = const_cast<char*>(data);
+    block->pool = NULL;
+    block->external = true;
+    block->release = release;
+    block->context = context;
+
+    Slice slice;
+    slice.block = block;
+    slice.begin = 0;
+    slice.end = static_cast<uint32_t>(size);
+    _slices.push_back(slice);
+    _size += size;
+}
+
+void CIoBuffer::prepend(const char* data, size_t size)
+{
+    if (!_slices.empty() && is_writable(_slices.front()) && (_slices.front().begin >= size))
+    {
+        Slice& head = _slices.front();
+        head.begin -= static_cast<uint32_t>(size);
+        memcpy(head.block->data + head.begin, data, size);
+        _size += size;
+        return;
+    }
+
+    // 新块中数据放在块尾，块前留出空间给之后的prepend
+    while (size > 0)
+    {
+        Slice slice;
+        slice.block = allocate_block();
+        const size_t bytes = std::min(size, static_cast<size_t>(slice.block->capacity));
+        slice.end = slice.block->capacity;
+        slice.begin = slice.end - static_cast<uint32_t>(bytes);
+        memcpy(slice.block->data + slice.begin, data + size - bytes, bytes);
+        _slices.push_front(slice);
+        _size += bytes;
+        size -= bytes;
+    }
+}
+
+bool CIoBuffer::slice(size_t offset, size_t size, CIoBuffer* out) const
+{
+    if ((offset > _size) || (size > _size - offset))
+        return false;
+
+    for (std::deque<Slice>::size_type i=0; (i<_slices.size()) && (size>0); ++i)
+    {
+        const Slice& slice = _slices[i];
+        const size_t slice_size = slice.end - slice.begin;
+        if (offset >= slice_size)
+        {
+            offset -= slice_size;
+            continue;
+        }
+
+        Slice shared;
+        const size_t bytes = std::min(size, slice_size - offset);
+        shared.block = slice.block;
+        shared.begin = slice.begin + static_cast<uint32_t>(offset);
+        shared.end = shared.begin + static_cast<uint32_t>(bytes);
+        ref_block(shared.block);
+        out->_slices.push_back(shared);
+        out->_size += bytes;
+        size -= bytes;
+        offset = 0;
+    }
+
+    return true;
+}
+
+bool CIoBuffer::split(size_t size, CIoBuffer* out)
+{
+    if (size > _size)
+        return false;
+
+    // 整片段直接移交，只有边界上的片段需要共享
+    while ((size > 0) && (size >= static_cast<size_t>(_slices.front().end - _slices.front().begin)))
+    {
+        const Slice& slice = _slices.front();
+        const size_t slice_size = slice.end - slice.begin;
+        out->_slices.push_back(slice);
+        out->_size += slice_size;
+        _slices.pop_front();
+        _size -= slice_size;
+        size -= slice_size;
+    }
+    if (size > 0)
+    {
+        (void)slice(0, size, out);
+        drain(size);
+    }
+
+    return true;
+}
+
+void CIoBuffer::drain(size_t size)
+{
+    while ((size > 0) && !_slices.empty())
+    {
+        Slice& slice = _slices.front();
+        const size_t slice_size = slice.end - slice.begin;
+        if (size < slice_size)
+        {
+            slice.begin += static_cast<uint32_t>(size);
+            _size -= size;
+            break;
+        }
+
+        unref_block(slice.block);
+        _slices.pop_front();
+        _size -= slice_size;
+        size -= slice_size;
+    }
+}
+
+void CIoBuffer::clear()
+{
+    drain(_size);
+    while (!_slices.empty()) // 空片段
+    {
+        unref_block(_slices.front().block);
+        _slices.pop_front();
+    }
+}
+
+bool CIoBuffer::copy_out(char* dest, size_t offset, size_t size) const
+{
+    if ((offset > _size) || (size > _size - offset))
+        return false;
+
+    for (std::deque<Slice>::size_type i=0; (i<_slices.size()) && (size>0); ++i)
+    {
+        const Slice& slice = _slices[i];
+        const size_t slice_size = slice.end - slice.begin;
+        if (offset >= slice_size)
+        {
+            offset -= slice_size;
+            continue;
+        }
+
+        const size_t bytes = std::min(size, slice_size - offset);
+        memcpy(dest, slice.block->data + slice.begin + offset, bytes);
+        dest += bytes;
+        size -= bytes;
+        offset = 0;
+    }
+
+    return true;
+}
+
+const char* CIoBuffer::pullup(size_t size)
+{
+    if ((size > _size) || (0 == size))
+        return NULL;
+    if (static_cast<size_t>(_slices.front().end - _slices.front().begin) >= size)
+        return _slices.front().block->data + _slices.front().begin;
+
+    // 比块大时从堆上分配一个足够大的块
+    Slice slice;
+    if (size <= _block_size)
+    {
+        slice.block = allocate_block();
+    }
+    else
+    {
+        slice.block = reinterpret_cast<Block*>(new char[sizeof(Block) + size]);
+        slice.block->refcount = 1;
+        slice.block->capacity = static_cast<uint32_t>(size);
+        slice.block->data = reinterpret_cast<char*>(slice.block) + sizeof(Block);
+        slice.block->pool = NULL;
+        slice.block->external = false;
+        get_mem_tracker()->allocate(sizeof(Block) + size);
+    }
+    slice.begin = 0;
+    slice.end = static_cast<uint32_t>(size);
+    (void)copy_out(slice.block->data, 0, size);
+    drain(size);
+    _slices.push_front(slice);
+    _size += size;
+    return slice.block->data;
+}
+
+int CIoBuffer::get_iovec(struct iovec* iov, int iovcnt) const
+{
+    int n = 0;
+    for (std::deque<Slice>::size_type i=0; (i<_slices.size()) && (n<iovcnt); ++i)
+    {
+        const Slice& slice = _slices[i];
+        if (slice.end > slice.begin)
+        {
+            iov[n].iov_base = slice.block->data + slice.begin;
+            iov[n].iov_len = slice.end - slice.begin;
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+bool CIoBuffer::pop_slice(const char** data, size_t* size, void** context)
+{
+    if (_slices.empty())
+        return false;
+
+    const Slice& slice = _slices.front();
+    *data = slice.block->data + slice.begin;
+    *size = slice.end - slice.begin;
+    *context = slice.block;
+    _size -= *size;
+    _slices.pop_front();
+    return true;
+}
+
+void CIoBuffer::release_slice(const char* data, size_t size, void* context)
+{
+    unref_block(static_cast<Block*>(context));
+}
+
+CIoBuffer::Block* CIoBuffer::allocate_block()
+{
+    Block* block = NULL;
+    if (_block_pool != NULL)
+    {
+        block = static_cast<Block*>(_block_pool->allocate());
+        if (block != NULL)
+            block->pool = _block_pool;
+    }
+    if (NULL == block)
+    {
+        // 池不够时从堆上分配同样大小的块
+        block = reinterpret_cast<Block*>(new char[sizeof(Block) + _block_size]);
+        block->pool = NULL;
+        get_mem_tracker()->allocate(sizeof(Block) + _block_size);
+    }
+
+    block->refcount = 1;
+    block->capacity = _block_size;
+    block->data = reinterpret_cast<char*>(block) + sizeof(Block);
+    block->external = false;
+    block->release = NULL;
+    block->context = NULL;
+    return block;
+}
+
+void CIoBuffer::ref_block(Block* block)
+{
+    __atomic_add_fetch(&block->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void CIoBuffer::unref_block(Block* block)
+{
+    if (__atomic_sub_fetch(&block->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    if (block->external)
+    {
+        if (block->release != NULL)
+            (*block->release)(block->data, block->capacity, block->context);
+        delete block;
+    }
+    else if (block->pool != NULL)
+    {
+        (void)block->pool->reclaim(block);
+    }
+    else
+    {
+        get_mem_tracker()->release(sizeof(Block) + block->capacity);
+        delete []reinterpret_cast<char*>(block);
+    }
+}
+
+// 只有独占的块才能在片段后写入，共享的块可能被其它缓冲区在其它线程中读取
+bool CIoBuffer::is_writable(const Slice& slice) const
+{
+    return !slice.block->external && (1 == __atomic_load_n(&slice.block->refcount, __ATOMIC_ACQUIRE));
+}
+
+int CIoBuffer::prepare_read(struct iovec* iov)
+{
+    int iovcnt = 0;
+    _read_into_tail = !_slices.empty() && is_writable(_slices.back()) && (_slices.back().end < _slices.back().block->capacity);
+    if (_read_into_tail)
+    {
+        const Slice& tail = _slices.back();
+        iov[iovcnt].iov_base = tail.block->data + tail.end;
+        iov[iovcnt].iov_len = tail.block->capacity - tail.end;
+        ++iovcnt;
+    }
+    if (NULL == _spare_block)
+        _spare_block = allocate_block();
+    iov[iovcnt].iov_base = _spare_block->data;
+    iov[iovcnt].iov_len = _spare_block->capacity;
+    ++iovcnt;
+    return iovcnt;
+}
+
+void CIoBuffer::commit_read(size_t bytes)
+{
+    _size += bytes;
+    if (_read_into_tail)
+    {
+        Slice& tail = _slices.back();
+        const size_t tail_bytes = std::min(bytes, static_cast<size_t>(tail.block->capacity - tail.end));
+        tail.end += static_cast<uint32_t>(tail_bytes);
+        bytes -= tail_bytes;
+    }
+    if (bytes > 0)
+    {
+        Slice slice;
+        slice.block = _spare_block;
+        slice.begin = 0;
+        slice.end = static_cast<uint32_t>(bytes);
+        _slices.push_back(slice);
+        _spare_block = NULL;
+    }
+}
+
+NET_NAMESPACE_END
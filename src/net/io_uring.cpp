@@ -0,0 +1,638 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/io_uring.h"
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+NET_NAMESPACE_BEGIN
+
+// 内部使用的user_data，同步操作的从USER_DATA_BEGIN开始递增
+#define TIMEOUT_USER_DATA   1 // 链接的超时
+#define MULTISHOT_USER_DATA 2 // multishot接收
+#define RECYCLE_USER_DATA   3 // 归还multishot接收的块
+#define USER_DATA_BEGIN     16
+#define ASYNC_USER_DATA_FLAG (1ULL << 63) // 异步操作的user_data为tag加上此标志
+
+#define BUFFER_GROUP_ID 0
+
+static pthread_key_t sg_ring_key;
+static pthread_once_t sg_ring_once = PTHREAD_ONCE_INIT;
+static __thread CIoUring* sg_thread_ring = NULL;
+static __thread bool sg_thread_ring_tried = false;
+
+static void delete_thread_ring(void* ring)
+{
+    delete static_cast<CIoUring*>(ring);
+}
+
+static void create_ring_key()
+{
+    (void)pthread_key_create(&sg_ring_key, delete_thread_ring);
+}
+
+#if HAVE_IO_URING
+static inline struct io_uring_sqe* to_sqe(void* sqe)
+{
+    return static_cast<struct io_uring_sqe*>(sqe);
+}
+
+static inline void set_timespec(struct __kernel_timespec* ts, uint32_t milliseconds)
+{
+    ts->tv_sec = milliseconds / 1000;
+    ts->tv_nsec = static_cast<long long>(milliseconds % 1000) * 1000000;
+}
+#endif // HAVE_IO_URING
+
+CIoUring::CIoUring()
+    :_ring_fd(-1)
+    ,_sq_entries(0)
+    ,_cq_entries(0)
+    ,_sq_ring(NULL)
+    ,_cq_ring(NULL)
+    ,_sqes(NULL)
+    ,_sq_ring_size(0)
+    ,_cq_ring_size(0)
+    ,_sq_head(NULL)
+    ,_sq_tail(NULL)
+    ,_sq_mask(NULL)
+    ,_sq_array(NULL)
+    ,_cq_head(NULL)
+    ,_cq_tail(NULL)
+    ,_cq_mask(NULL)
+    ,_cqes(NULL)
+    ,_sq_local_tail(0)
+    ,_submit_number(0)
+    ,_next_user_data(USER_DATA_BEGIN)
+    ,_enter_number(0)
+    ,_provided_buffer(NULL)
+    ,_provided_size(0)
+{
+}
+
+CIoUring::~CIoUring()
+{
+    destroy();
+}
+
+bool CIoUring::is_supported()
+{
+    static int supported = -1;
+
+    if (-1 == supported)
+    {
+        CIoUring ring;
+        try
+        {
+            ring.create(4);
+            supported = 1;
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            supported = 0;
+        }
+    }
+
+    return 1 == supported;
+}
+
+CIoUring* CIoUring::get_thread_ring()
+{
+    if (!sg_thread_ring_tried)
+    {
+        sg_thread_ring_tried = true;
+        if (is_supported())
+        {
+            (void)pthread_once(&sg_ring_once, create_ring_key);
+
+            CIoUring* ring = new CIoUring;
+            try
+            {
+                ring->create();
+                sg_thread_ring = ring;
+                (void)pthread_setspecific(sg_ring_key, ring);
+            }
+            catch (sys::CSyscallException& ex)
+            {
+                delete ring;
+            }
+        }
+    }
+
+    return sg_thread_ring;
+}
+
+void CIoUring::create(uint32_t entries)
+{
+#if HAVE_IO_URING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (-1 == ring_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_setup");
+    // 需要EXT_ARG支持等待超时，5.11之前的内核不使用
+    if (0 == (params.features & IORING_FEAT_EXT_ARG))
+    {
+        ::close(ring_fd);
+        THROW_SYSCALL_EXCEPTION(NULL, ENOSYS, "io_uring_setup");
+    }
+
+    _ring_fd = ring_fd;
+    _sq_entries = params.sq_entries;
+    _cq_entries = params.cq_entries;
+    _sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(uint32_t);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (_cq_ring_size > _sq_ring_size)
+            _sq_ring_size = _cq_ring_size;
+        _cq_ring_size = _sq_ring_size;
+    }
+
+    _sq_ring = mmap(NULL, _sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == _sq_ring)
+    {
+        int errcode = errno;
+        _sq_ring = NULL;
+        destroy();
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        _cq_ring = _sq_ring;
+    }
+    else
+    {
+        _cq_ring = mmap(NULL, _cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == _cq_ring)
+        {
+            int errcode = errno;
+            _cq_ring = NULL;
+            destroy();
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+        }
+    }
+    _sqes = mmap(NULL, params.sq_entries*sizeof(struct io_uring_sqe), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == _sqes)
+    {
+        int errcode = errno;
+        _sqes = NULL;
+        destroy();
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+    }
+
+    char* sq_ring = static_cast<char*>(_sq_ring);
+    char* cq_ring = static_cast<char*>(_cq_ring);
+    _sq_head = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.head);
+    _sq_tail = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.tail);
+    _sq_mask = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.array);
+    _cq_head = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.head);
+    _cq_tail = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.tail);
+    _cq_mask = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.ring_mask);
+    _cqes = cq_ring + params.cq_off.cqes;
+    _sq_local_tail = *_sq_tail;
+    _submit_number = 0;
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOSYS, "io_uring_setup");
+#endif // HAVE_IO_URING
+}
+
+void CIoUring::destroy()
+{
+#if HAVE_IO_URING
+    if (_sqes != NULL)
+        (void)munmap(_sqes, _sq_entries*sizeof(struct io_uring_sqe));
+    if ((_cq_ring != NULL) && (_cq_ring != _sq_ring))
+        (void)munmap(_cq_ring, _cq_ring_size);
+    if (_sq_ring != NULL)
+        (void)munmap(_sq_ring, _sq_ring_size);
+#endif // HAVE_IO_URING
+    if (_ring_fd != -1)
+        ::close(_ring_fd);
+
+    _ring_fd = -1;
+    _sq_ring = NULL;
+    _cq_ring = NULL;
+    _sqes = NULL;
+    _provided_buffer = NULL;
+    _multishot_completions.clear();
+    _async_completions.clear();
+}
+
+#if HAVE_IO_URING
+int CIoUring::recv(int fd, void* buffer, size_t buffer_size, int flags, uint32_t milliseconds)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe((milliseconds > 0)? 2: 1));
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(buffer_size);
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    return execute(sqe, milliseconds);
+}
+
+int CIoUring::send(int fd, const void* buffer, size_t buffer_size, int flags, uint32_t milliseconds)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe((milliseconds > 0)? 2: 1));
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(buffer_size);
+    sqe->msg_flags = static_cast<uint32_t>(flags | MSG_NOSIGNAL);
+    return execute(sqe, milliseconds);
+}
+
+int CIoUring::readv(int fd, const struct iovec* iov, int iovcnt, uint32_t milliseconds)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe((milliseconds > 0)? 2: 1));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->off = static_cast<uint64_t>(-1); // 不可定位的文件，从当前位置
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = static_cast<uint32_t>(iovcnt);
+    return execute(sqe, milliseconds);
+}
+
+int CIoUring::writev(int fd, const struct iovec* iov, int iovcnt, uint32_t milliseconds)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe((milliseconds > 0)? 2: 1));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = static_cast<uint32_t>(iovcnt);
+    return execute(sqe, milliseconds);
+}
+
+void CIoUring::register_buffers(const struct iovec* iov, uint32_t iovcnt)
+{
+    if (-1 == syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_BUFFERS, iov, iovcnt))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_register");
+}
+
+void CIoUring::unregister_buffers()
+{
+    (void)syscall(__NR_io_uring_register, _ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+}
+
+int CIoUring::read_fixed(int fd, void* buffer, size_t buffer_size, uint16_t buffer_index, uint32_t milliseconds)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe((milliseconds > 0)? 2: 1));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(buffer_size);
+    sqe->buf_index = buffer_index;
+    return execute(sqe, milliseconds);
+}
+
+int CIoUring::write_fixed(int fd, const void* buffer, size_t buffer_size, uint16_t buffer_index, uint32_t milliseconds)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe((milliseconds > 0)? 2: 1));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(buffer_size);
+    sqe->buf_index = buffer_index;
+    return execute(sqe, milliseconds);
+}
+
+void CIoUring::provide_buffers(char* buffer, uint32_t buffer_size, uint16_t buffer_number)
+{
+    _provided_buffer = buffer;
+    _provided_size = buffer_size;
+
+    int res = execute(prep_provide_buffers(buffer, buffer_number, 0), 0);
+    if (res < 0)
+        THROW_SYSCALL_EXCEPTION(NULL, -res, "IORING_OP_PROVIDE_BUFFERS");
+}
+
+void CIoUring::start_multishot_receive(int fd)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe());
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP_ID;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = MULTISHOT_USER_DATA;
+    submit(0, 0);
+}
+
+int CIoUring::wait_multishot_receive(char** data, uint16_t* buffer_id, bool* more, uint32_t milliseconds)
+{
+    // 先提交已归还的块，否则完成事件一直就绪时块永远不会还给内核
+    if (_submit_number > 0)
+        submit(0, 0);
+
+    while (_multishot_completions.empty())
+    {
+        Completion completion;
+        if (!reap(&completion))
+        {
+            // 等待超时返回-ETIME
+            const uint64_t enter_number = _enter_number;
+            submit(1, milliseconds);
+            if ((milliseconds > 0) && (enter_number == _enter_number))
+                return -ETIMEDOUT;
+            continue;
+        }
+
+        if (MULTISHOT_USER_DATA == completion.user_data)
+            _multishot_completions.push_back(completion);
+        else if (completion.user_data & ASYNC_USER_DATA_FLAG)
+            _async_completions.push_back(completion);
+    }
+
+    const Completion completion = _multishot_completions.front();
+    _multishot_completions.pop_front();
+    *more = (completion.flags & IORING_CQE_F_MORE) != 0;
+    if (completion.flags & IORING_CQE_F_BUFFER)
+    {
+        *buffer_id = static_cast<uint16_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+        *data = _provided_buffer + static_cast<size_t>(_provided_size) * (*buffer_id);
+    }
+    else
+    {
+        *buffer_id = 0;
+        *data = NULL;
+    }
+
+    return completion.res;
+}
+
+void CIoUring::recycle_buffer(uint16_t buffer_id)
+{
+    // 不单独提交，随下一次wait_multishot_receive或其它操作一起提交
+    struct io_uring_sqe* sqe = to_sqe(prep_provide_buffers(_provided_buffer+static_cast<size_t>(_provided_size)*buffer_id, 1, buffer_id));
+    sqe->user_data = RECYCLE_USER_DATA;
+}
+
+void CIoUring::queue_pread(int fd, void* buffer, size_t buffer_size, uint64_t offset, uint64_t tag)
+{
+    (void)prep_file_io(IORING_OP_READ, fd, buffer, buffer_size, offset, tag);
+}
+
+void CIoUring::queue_pwrite(int fd, const void* buffer, size_t buffer_size, uint64_t offset, uint64_t tag)
+{
+    (void)prep_file_io(IORING_OP_WRITE, fd, buffer, buffer_size, offset, tag);
+}
+
+void CIoUring::queue_fsync(int fd, bool datasync, uint64_t tag)
+{
+    struct io_uring_sqe* sqe = to_sqe(prep_file_io(IORING_OP_FSYNC, fd, NULL, 0, 0, tag));
+    if (datasync)
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+}
+
+int CIoUring::wait_completions(uint64_t* tags, int* results, int max_number, int min_number)
+{
+    int number = 0;
+    if (min_number > max_number)
+        min_number = max_number;
+
+    for (;;)
+    {
+        // 先取同步操作等待期间收到的
+        while ((number < max_number) && !_async_completions.empty())
+        {
+            tags[number] = _async_completions.front().user_data & ~ASYNC_USER_DATA_FLAG;
+            results[number] = _async_completions.front().res;
+            _async_completions.pop_front();
+            ++number;
+        }
+
+        Completion completion;
+        while ((number < max_number) && reap(&completion))
+        {
+            if (MULTISHOT_USER_DATA == completion.user_data)
+            {
+                _multishot_completions.push_back(completion);
+            }
+            else if (completion.user_data & ASYNC_USER_DATA_FLAG)
+            {
+                tags[number] = completion.user_data & ~ASYNC_USER_DATA_FLAG;
+                results[number] = completion.res;
+                ++number;
+            }
+        }
+
+        // 没有需要提交的，且已取够
+        if ((number >= min_number) && (0 == _submit_number))
+            break;
+        submit((number >= min_number)? 0: 1, 0);
+    }
+
+    return number;
+}
+
+// reserve_number为需要的空闲SQE个数，有链接的超时时为2，链接的两个SQE不能被分开提交
+void* CIoUring::get_sqe(uint32_t reserve_number)
+{
+    // 提交队列不够时先提交
+    if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) + reserve_number > _sq_entries)
+        submit(0, 0);
+
+    const uint32_t index = _sq_local_tail & *_sq_mask;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(_sqes) + index;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    _sq_array[index] = index;
+    ++_sq_local_tail;
+    ++_submit_number;
+    return sqe;
+}
+
+void* CIoUring::prep_provide_buffers(char* buffer, uint16_t buffer_number, uint16_t buffer_id)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe());
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = buffer_number;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = _provided_size;
+    sqe->off = buffer_id;
+    sqe->buf_group = BUFFER_GROUP_ID;
+    return sqe;
+}
+
+void* CIoUring::prep_file_io(uint8_t opcode, int fd, const void* buffer, size_t buffer_size, uint64_t offset, uint64_t tag)
+{
+    struct io_uring_sqe* sqe = to_sqe(get_sqe());
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(buffer_size);
+    sqe->user_data = tag | ASYNC_USER_DATA_FLAG;
+    return sqe;
+}
+
+// 提交sqe及之前未提交的SQE，并等待sqe完成，需要时为sqe链接一个超时
+int CIoUring::execute(void* sqe, uint32_t milliseconds)
+{
+    struct __kernel_timespec ts;
+    const uint64_t user_data = _next_user_data++;
+    int expected = 1;
+    int res = 0;
+    bool timed_out = false;
+
+    to_sqe(sqe)->user_data = user_data;
+    if (milliseconds > 0)
+    {
+        // 链接的超时在提交时读取ts，之后ts即可释放
+        to_sqe(sqe)->flags |= IOSQE_IO_LINK;
+        set_timespec(&ts, milliseconds);
+
+        struct io_uring_sqe* timeout_sqe = to_sqe(get_sqe());
+        timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        timeout_sqe->fd = -1;
+        timeout_sqe->addr = reinterpret_cast<uint64_t>(&ts);
+        timeout_sqe->len = 1;
+        timeout_sqe->user_data = TIMEOUT_USER_DATA;
+        ++expected;
+    }
+
+    submit(static_cast<uint32_t>(expected), 0);
+    while (expected > 0)
+    {
+        Completion completion;
+        if (!reap(&completion))
+        {
+            submit(1, 0);
+            continue;
+        }
+
+        if (user_data == completion.user_data)
+        {
+            res = completion.res;
+            --expected;
+        }
+        else if (TIMEOUT_USER_DATA == completion.user_data)
+        {
+            timed_out = (-ETIME == completion.res);
+            --expected;
+        }
+        else if (MULTISHOT_USER_DATA == completion.user_data)
+        {
+            _multishot_completions.push_back(completion);
+        }
+        else if (completion.user_data & ASYNC_USER_DATA_FLAG)
+        {
+            _async_completions.push_back(completion);
+        }
+    }
+
+    // 被超时取消，且没有部分完成
+    if (timed_out && (-ECANCELED == res))
+        res = -ETIMEDOUT;
+    return res;
+}
+
+// 提交所有未提交的SQE，并等待至少wait_number个完成事件，milliseconds为0时不超时
+void CIoUring::submit(uint32_t wait_number, uint32_t milliseconds)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    uint32_t flags = (wait_number > 0)? IORING_ENTER_GETEVENTS: 0;
+    void* argp = NULL;
+    size_t argsz = 0;
+
+    if ((wait_number > 0) && (milliseconds > 0))
+    {
+        memset(&arg, 0, sizeof(arg));
+        set_timespec(&ts, milliseconds);
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    for (;;)
+    {
+        int ret = static_cast<int>(syscall(__NR_io_uring_enter, _ring_fd, _submit_number, wait_number, flags, argp, argsz));
+        if (ret >= 0)
+        {
+            ++_enter_number;
+            _submit_number -= static_cast<uint32_t>(ret);
+            break;
+        }
+
+        if (EINTR == errno)
+            continue;
+        if (ETIME == errno) // 等待超时，SQE已提交
+        {
+            _submit_number = 0;
+            break;
+        }
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_enter");
+    }
+}
+
+bool CIoUring::reap(Completion* completion)
+{
+    const uint32_t head = *_cq_head;
+    if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    const struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>(_cqes) + (head & *_cq_mask);
+    completion->user_data = cqe->user_data;
+    completion->res = cqe->res;
+    completion->flags = cqe->flags;
+    __atomic_store_n(_cq_head, head+1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else // !HAVE_IO_URING
+
+int CIoUring::recv(int, void*, size_t, int, uint32_t) { return -ENOSYS; }
+int CIoUring::send(int, const void*, size_t, int, uint32_t) { return -ENOSYS; }
+int CIoUring::readv(int, const struct iovec*, int, uint32_t) { return -ENOSYS; }
+int CIoUring::writev(int, const struct iovec*, int, uint32_t) { return -ENOSYS; }
+void CIoUring::register_buffers(const struct iovec*, uint32_t) { THROW_SYSCALL_EXCEPTION(NULL, ENOSYS, "io_uring_register"); }
+void CIoUring::unregister_buffers() {}
+int CIoUring::read_fixed(int, void*, size_t, uint16_t, uint32_t) { return -ENOSYS; }
+int CIoUring::write_fixed(int, const void*, size_t, uint16_t, uint32_t) { return -ENOSYS; }
+void CIoUring::provide_buffers(char*, uint32_t, uint16_t) { THROW_SYSCALL_EXCEPTION(NULL, ENOSYS, "IORING_OP_PROVIDE_BUFFERS"); }
+void CIoUring::start_multishot_receive(int) { THROW_SYSCALL_EXCEPTION(NULL, ENOSYS, "io_uring_enter"); }
+int CIoUring::wait_multishot_receive(char**, uint16_t*, bool* more, uint32_t) { *more = false; return -ENOSYS; }
+void CIoUring::recycle_buffer(uint16_t) {}
+void CIoUring::queue_pread(int, void*, size_t, uint64_t, uint64_t) {}
+void CIoUring::queue_pwrite(int, const void*, size_t, uint64_t, uint64_t) {}
+void CIoUring::queue_fsync(int, bool, uint64_t) {}
+int CIoUring::wait_completions(uint64_t*, int*, int, int) { return -ENOSYS; }
+void* CIoUring::get_sqe(uint32_t) { return NULL; }
+void* CIoUring::prep_provide_buffers(char*, uint16_t, uint16_t) { return NULL; }
+void* CIoUring::prep_file_io(uint8_t, int, const void*, size_t, uint64_t, uint64_t) { return NULL; }
+int CIoUring::execute(void*, uint32_t) { return -ENOSYS; }
+void CIoUring::submit(uint32_t, uint32_t) {}
+bool CIoUring::reap(Completion*) { return false; }
+#endif // HAVE_IO_URING
+
+NET_NAMESPACE_END
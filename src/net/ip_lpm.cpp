@@ -0,0 +1,378 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/ip_lpm.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+NET_NAMESPACE_BEGIN
+
+// 主机字节序的前缀掩码
+static inline uint32_t ipv4_mask(uint8_t depth)
+{
+    return (0 == depth)? 0: (0xFFFFFFFFU << (32 - depth));
+}
+
+CIpv4LpmTable::CIpv4LpmTable()
+    : _tbl24(1 << 24, 0)
+{
+}
+
+void CIpv4LpmTable::insert(uint32_t ip, uint8_t depth, uint32_t next_hop)
+{
+    if (depth > 32)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("invalid depth: %u", depth), EINVAL);
+    if (next_hop > MAX_NEXT_HOP)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("next hop %u greater than %u", next_hop, MAX_NEXT_HOP), EINVAL);
+
+    const uint32_t prefix = ntohl(ip) & ipv4_mask(depth);
+    _rules[rule_key(prefix, depth)] = next_hop;
+    fill(prefix, depth, make_entry(depth, next_hop), false);
+}
+
+bool CIpv4LpmTable::remove(uint32_t ip, uint8_t depth)
+{
+    if (depth > 32)
+        return false;
+
+    const uint32_t prefix = ntohl(ip) & ipv4_mask(depth);
+    std::map<uint64_t, uint32_t>::iterator iter = _rules.find(rule_key(prefix, depth));
+    if (iter == _rules.end())
+        return false;
+
+    _rules.erase(iter);
+    fill(prefix, depth, find_parent_entry(prefix, depth), true);
+    return true;
+}
+
+void CIpv4LpmTable::clear()
+{
+    std::fill(_tbl24.begin(), _tbl24.end(), 0);
+    std::vector<uint32_t>().swap(_tbl8);
+    _free_groups.clear();
+    _rules.clear();
+}
+
+size_t CIpv4LpmTable::lookup(const uint32_t* ips, size_t count, uint32_t* next_hops, bool* found) const
+{
+    enum { BATCH = 8 };
+    size_t num_found = 0;
+
+    for (size_t i=0; i<count; i+=BATCH)
+    {
+        const size_t n = std::min<size_t>(BATCH, count-i);
+        uint32_t host_ips[BATCH];
+        uint32_t entries[BATCH];
+
+        // 先发出一批一级表的访存，再发出二级表的，缓存缺失相互重叠
+        for (size_t j=0; j<n; ++j)
+        {
+            host_ips[j] = ntohl(ips[i+j]);
+            __builtin_prefetch(&_tbl24[host_ips[j] >> 8]);
+        }
+        for (size_t j=0; j<n; ++j)
+        {
+            entries[j] = _tbl24[host_ips[j] >> 8];
+            if (entries[j] & ENTRY_EXTENDED)
+                __builtin_prefetch(&_tbl8[((entries[j] & ENTRY_VALUE_MASK) << 8) | (host_ips[j] & 0xFF)]);
+        }
+        for (size_t j=0; j<n; ++j)
+        {
+            uint32_t entry = entries[j];
+            if (entry & ENTRY_EXTENDED)
+                entry = _tbl8[((entry & ENTRY_VALUE_MASK) << 8) | (host_ips[j] & 0xFF)];
+
+            const bool valid = (entry & ENTRY_VALID) != 0;
+            if (valid)
+            {
+                next_hops[i+j] = entry & ENTRY_VALUE_MASK;
+                ++num_found;
+            }
+            if (found != NULL)
+                found[i+j] = valid;
+        }
+    }
+
+    return num_found;
+}
+
+void CIpv4LpmTable::fill(uint32_t prefix, uint8_t depth, uint32_t entry, bool removing)
+{
+    if (depth <= 24)
+    {
+        const uint32_t first = prefix >> 8;
+        const uint32_t last = first + (1U << (24 - depth)) - 1;
+
+        for (uint32_t i=first; i<=last; ++i)
+        {
+            const uint32_t old_entry = _tbl24[i];
+            if (old_entry & ENTRY_EXTENDED)
+            {
+                fill_tbl8(old_entry & ENTRY_VALUE_MASK, 0, 255, depth, entry, removing);
+                if (removing)
+                    try_reclaim_group(i);
+            }
+            else if (removing)
+            {
+                if ((old_entry & ENTRY_VALID) && (get_depth(old_entry) == depth))
+                    _tbl24[i] = entry;
+            }
+            else if ((0 == (old_entry & ENTRY_VALID)) || (get_depth(old_entry) <= depth))
+            {
+                _tbl24[i] = entry;
+            }
+        }
+    }
+    else
+    {
+        const uint32_t index24 = prefix >> 8;
+        const uint32_t first = prefix & 0xFF;
+        const uint32_t last = first + (1U << (32 - depth)) - 1;
+
+        if (0 == (_tbl24[index24] & ENTRY_EXTENDED))
+        {
+            if (removing) // 删除的路由一定在二级表中
+                return;
+            _tbl24[index24] = ENTRY_EXTENDED | allocate_group(_tbl24[index24]);
+        }
+
+        fill_tbl8(_tbl24[index24] & ENTRY_VALUE_MASK, first, last, depth, entry, removing);
+        if (removing)
+            try_reclaim_group(index24);
+    }
+}
+
+void CIpv4LpmTable::fill_tbl8(uint32_t group, uint32_t first, uint32_t last, uint8_t depth, uint32_t entry, bool removing)
+{
+    uint32_t* entries = &_tbl8[group << 8];
+
+    for (uint32_t i=first; i<=last; ++i)
+    {
+        const uint32_t old_entry = entries[i];
+        if (removing)
+        {
+            if ((old_entry & ENTRY_VALID) && (get_depth(old_entry) == depth))
+                entries[i] = entry;
+        }
+        else if ((0 == (old_entry & ENTRY_VALID)) || (get_depth(old_entry) <= depth))
+        {
+            entries[i] = entry;
+        }
+    }
+}
+
+// 新的二级表组的256项都继承一级表项原来的值
+uint32_t CIpv4LpmTable::allocate_group(uint32_t entry)
+{
+    uint32_t group;
+
+    if (!_free_groups.empty())
+    {
+        group = _free_groups.back();
+        _free_groups.pop_back();
+    }
+    else
+    {
+        group = static_cast<uint32_t>(_tbl8.size() >> 8);
+        if (group > ENTRY_VALUE_MASK)
+            THROW_EXCEPTION("too many tbl8 groups", ENOMEM);
+        _tbl8.resize(_tbl8.size() + 256);
+    }
+
+    std::fill(_tbl8.begin() + (group << 8), _tbl8.begin() + ((group + 1) << 8), entry);
+    return group;
+}
+
+// 组内256项相同且不属于长于24位的路由时，折叠回一级表
+void CIpv4LpmTable::try_reclaim_group(uint32_t index24)
+{
+    const uint32_t group = _tbl24[index24] & ENTRY_VALUE_MASK;
+    const uint32_t* entries = &_tbl8[group << 8];
+    const uint32_t entry = entries[0];
+
+    if ((entry & ENTRY_VALID) && (get_depth(entry) > 24))
+        return;
+    for (uint32_t i=1; i<256; ++i)
+    {
+        if (entries[i] != entry)
+            return;
+    }
+
+    _tbl24[index24] = entry;
+    _free_groups.push_back(group);
+}
+
+uint32_t CIpv4LpmTable::find_parent_entry(uint32_t prefix, uint8_t depth) const
+{
+    for (int d=depth-1; d>=0; --d)
+    {
+        std::map<uint64_t, uint32_t>::const_iterator iter = _rules.find(rule_key(prefix & ipv4_mask(d), d));
+        if (iter != _rules.end())
+            return make_entry(d, iter->second);
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CIpv6LpmTable::CIpv6LpmTable()
+    : _direct(1 << 16, NO_ROUTE)
+{
+}
+
+CIpv6LpmTable::Prefix CIpv6LpmTable::make_prefix(const uint32_t* ip, uint8_t depth)
+{
+    Prefix prefix;
+    prefix.high = load_be64(ip);
+    prefix.low = load_be64(ip+2);
+    prefix.depth = depth;
+
+    // 清除前缀长度之后的位
+    if (depth < 64)
+    {
+        prefix.high &= (0 == depth)? 0: (~0ULL << (64 - depth));
+        prefix.low = 0;
+    }
+    else if (depth < 128)
+    {
+        prefix.low &= (64 == depth)? 0: (~0ULL << (128 - depth));
+    }
+    return prefix;
+}
+
+void CIpv6LpmTable::insert(const uint32_t* ip, uint8_t depth, uint32_t next_hop)
+{
+    if (depth > 128)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("invalid depth: %u", depth), EINVAL);
+    if (next_hop > MAX_NEXT_HOP)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("next hop %u greater than %u", next_hop, MAX_NEXT_HOP), EINVAL);
+
+    _rules[make_prefix(ip, depth)] = next_hop;
+}
+
+bool CIpv6LpmTable::remove(const uint32_t* ip, uint8_t depth)
+{
+    return (depth <= 128) && (_rules.erase(make_prefix(ip, depth)) > 0);
+}
+
+void CIpv6LpmTable::clear()
+{
+    _rules.clear();
+}
+
+// 按前缀长度从短到长，展开时长的覆盖短的
+struct CompareDepth
+{
+    template <class Rule>
+    bool operator ()(const Rule* lhs, const Rule* rhs) const
+    {
+        return lhs->first.depth < rhs->first.depth;
+    }
+};
+
+void CIpv6LpmTable::build()
+{
+    std::vector<const Rule*> rules;
+    rules.reserve(_rules.size());
+    for (rule_table_t::const_iterator iter=_rules.begin(); iter!=_rules.end(); ++iter)
+        rules.push_back(&*iter);
+    std::stable_sort(rules.begin(), rules.end(), CompareDepth());
+
+    _direct.assign(1 << 16, NO_ROUTE);
+    _nodes.clear();
+    _leaves.clear();
+
+    // 不长于16位的展开到直接表，更长的按高16位分组，各组建一棵子树
+    std::map<uint32_t, std::vector<const Rule*> > groups;
+    for (std::vector<const Rule*>::size_type i=0; i<rules.size(); ++i)
+    {
+        const Rule* rule = rules[i];
+        const uint32_t top = static_cast<uint32_t>(rule->first.high >> 48);
+
+        if (rule->first.depth <= 16)
+            std::fill(_direct.begin() + top, _direct.begin() + top + (1 << (16 - rule->first.depth)), rule->second);
+        else
+            groups[top].push_back(rule);
+    }
+
+    for (std::map<uint32_t, std::vector<const Rule*> >::const_iterator iter=groups.begin(); iter!=groups.end(); ++iter)
+    {
+        const uint32_t index = static_cast<uint32_t>(_nodes.size());
+        _nodes.resize(index + 1);
+        build_node(iter->second, 16, _direct[iter->first], index);
+        _direct[iter->first] = DIRECT_NODE | index;
+    }
+}
+
+// rules都比offset长且覆盖此结点的前缀，按前缀长度从短到长排列，
+// inherited为覆盖此结点的更短前缀中最长的，先算出64个子各自的叶子值，再为须细分的子递归
+uint32_t CIpv6LpmTable::build_node(const std::vector<const Rule*>& rules, uint32_t offset, uint32_t inherited, uint32_t index)
+{
+    uint32_t slots[64];
+    std::vector<const Rule*> children[64];
+    uint64_t vector = 0;
+    uint64_t leafvec = 0;
+
+    std::fill(slots, slots+64, inherited);
+    for (std::vector<const Rule*>::size_type i=0; i<rules.size(); ++i)
+    {
+        const Rule* rule = rules[i];
+        const uint32_t v = extract6(rule->first.high, rule->first.low, offset);
+
+        if (rule->first.depth <= offset + 6)
+        {
+            const uint32_t span = 1U << (offset + 6 - rule->first.depth);
+            std::fill(slots + v, slots + v + span, rule->second);
+        }
+        else
+        {
+            children[v].push_back(rule);
+            vector |= 1ULL << v;
+        }
+    }
+
+    const uint32_t base0 = static_cast<uint32_t>(_leaves.size());
+    const uint32_t base1 = static_cast<uint32_t>(_nodes.size());
+    bool has_leaf = false;
+    for (uint32_t v=0; v<64; ++v)
+    {
+        if (vector & (1ULL << v))
+            continue;
+        if (!has_leaf || (slots[v] != _leaves.back()))
+        {
+            leafvec |= 1ULL << v;
+            _leaves.push_back(slots[v]);
+            has_leaf = true;
+        }
+    }
+
+    // 子结点连续存放，先占位再逐个递归填充
+    _nodes.resize(base1 + __builtin_popcountll(vector));
+    _nodes[index].vector = vector;
+    _nodes[index].leafvec = leafvec;
+    _nodes[index].base0 = base0;
+    _nodes[index].base1 = base1;
+    for (uint32_t v=0, k=0; v<64; ++v)
+    {
+        if (vector & (1ULL << v))
+            build_node(children[v], offset + 6, slots[v], base1 + k++);
+    }
+
+    return index;
+}
+
+NET_NAMESPACE_END
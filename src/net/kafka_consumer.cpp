@@ -1,7 +1,11 @@
 // Writed by yijian on 2019/8/5
 #include "net/kafka_consumer.h"
 #include "sys/datetime_utils.h"
+#include "sys/event.h"
+#include "sys/lock.h"
 #include "sys/log.h"
+#include "sys/thread_engine.h"
+#include <deque>
 #include <time.h>
 #if MOOON_HAVE_LIBRDKAFKA==1
 NET_NAMESPACE_BEGIN
@@ -67,9 +71,122 @@ private:
     }
 };
 
+// 一个分区的工作线程，按到达顺序处理分派来的批
+class CKafkaPartitionWorker
+{
+public:
+    CKafkaPartitionWorker(int32_t partition, IKafkaPartitionHandler* handler, int max_pending_batches)
+        : _partition(partition), _handler(handler), _max_pending_batches(max_pending_batches),
+          _stop(false), _processed_offset(-1), _committed_offset(-1), _engine(NULL)
+    {
+        _engine = new sys::CThreadEngine(sys::bind(&CKafkaPartitionWorker::run, this));
+    }
+
+    ~CKafkaPartitionWorker()
+    {
+        stop();
+    }
+
+    // 处理完已分派的批后退出线程
+    void stop()
+    {
+        if (NULL == _engine)
+            return;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            _stop = true;
+            _not_empty.signal();
+        }
+
+        _engine->join();
+        delete _engine;
+        _engine = NULL;
+    }
+
+    // 接管batch，积压满时阻塞等待
+    void push(CKafkaMessageBatch* batch)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        while (static_cast<int>(_batches.size()) >= _max_pending_batches)
+            _not_full.wait(_lock);
+        _batches.push_back(batch);
+        _not_empty.signal();
+    }
+
+    // 取得上次调用以来新处理完的最大offset，没有时返回false
+    bool pop_processed_offset(int64_t* offset)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_processed_offset == _committed_offset)
+            return false;
+        *offset = _processed_offset;
+        _committed_offset = _processed_offset;
+        return true;
+    }
+
+    int32_t get_partition() const { return _partition; }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            CKafkaMessageBatch* batch = NULL;
+            {
+                sys::LockHelper<sys::CLock> lock_helper(_lock);
+                while (_batches.empty() && !_stop)
+                    _not_empty.wait(_lock);
+                if (_batches.empty())
+                    break;
+                batch = _batches.front();
+                _batches.pop_front();
+                _not_full.signal();
+            }
+
+            try
+            {
+                _handler->handle(_partition, *batch);
+            }
+            catch (std::exception& ex)
+            {
+                MYLOG_ERROR("Handle partition[%d] error: %s.\n", _partition, ex.what());
+            }
+
+            const int64_t offset = batch->get_offset(batch->size()-1);
+            delete batch;
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            _processed_offset = offset;
+        }
+    }
+
+private:
+    const int32_t _partition;
+    IKafkaPartitionHandler* _handler;
+    const int _max_pending_batches;
+    sys::CLock _lock;
+    sys::CEvent _not_empty;
+    sys::CEvent _not_full;
+    std::deque<CKafkaMessageBatch*> _batches;
+    bool _stop;
+    int64_t _processed_offset; // 已处理完的最大offset
+    int64_t _committed_offset; // 已交给提交的offset
+    sys::CThreadEngine* _engine;
+};
+
+// CKafkaMessageBatch
+
+void CKafkaMessageBatch::clear()
+{
+    for (std::vector<RdKafka::Message*>::size_type i=0; i<_messages.size(); ++i)
+        delete _messages[i];
+    _messages.clear();
+}
+
 // CKafkaConsumer
 
 CKafkaConsumer::CKafkaConsumer(RdKafka::EventCb* event_cb, RdKafka::ConsumeCb* consume_cb, RdKafka::RebalanceCb* rebalance_cb, RdKafka::OffsetCommitCb* offset_commitcb)
+    : _partition_handler(NULL), _max_pending_batches(0)
 {
     // KafkaConsumer::create和Producer::create
     // 调用HandleImpl::set_common_config注册下列回调。
@@ -101,6 +218,8 @@ CKafkaConsumer::CKafkaConsumer(RdKafka::EventCb* event_cb, RdKafka::ConsumeCb* c
 
 CKafkaConsumer::~CKafkaConsumer()
 {
+    stop_partition_workers();
+
     // Close and shut down the proper
     // 最大阻塞时间由配置session.timeout.ms指定
     // 过程中RdKafka::RebalanceCb和RdKafka::OffsetCommitCb可能被调用
@@ -323,6 +442,124 @@ int CKafkaConsumer::consume_batch(int batch_size, std::vector<std::string>* logs
     return num_logs;
 }
 
+int CKafkaConsumer::consume_batch(int batch_size, CKafkaMessageBatch* batch, int timeout_ms)
+{
+    batch->clear();
+    return consume_messages(batch_size, timeout_ms, &batch->_messages);
+}
+
+void CKafkaConsumer::start_partition_workers(IKafkaPartitionHandler* handler, int max_pending_batches)
+{
+    _partition_handler = handler;
+    _max_pending_batches = (max_pending_batches > 0)? max_pending_batches: 1;
+}
+
+int CKafkaConsumer::dispatch_batch(int batch_size, int timeout_ms)
+{
+    std::vector<RdKafka::Message*> messages;
+    const int num_messages = consume_messages(batch_size, timeout_ms, &messages);
+
+    // 按分区拆分，分区内保持消费到的顺序
+    std::map<int32_t, CKafkaMessageBatch*> batches;
+    for (std::vector<RdKafka::Message*>::size_type i=0; i<messages.size(); ++i)
+    {
+        CKafkaMessageBatch*& batch = batches[messages[i]->partition()];
+        if (NULL == batch)
+            batch = new CKafkaMessageBatch;
+        batch->_messages.push_back(messages[i]);
+    }
+    for (std::map<int32_t, CKafkaMessageBatch*>::iterator iter=batches.begin(); iter!=batches.end(); ++iter)
+    {
+        CKafkaPartitionWorker*& worker = _partition_workers[iter->first];
+        if (NULL == worker)
+        {
+            MYLOG_INFO("Create worker for topic://%s, partition:%d.\n", _topic_str.c_str(), iter->first);
+            worker = new CKafkaPartitionWorker(iter->first, _partition_handler, _max_pending_batches);
+        }
+        worker->push(iter->second);
+    }
+
+    (void)commit_processed(false);
+    return num_messages;
+}
+
+void CKafkaConsumer::stop_partition_workers()
+{
+    if (_partition_workers.empty())
+        return;
+
+    std::map<int32_t, CKafkaPartitionWorker*>::iterator iter;
+    for (iter=_partition_workers.begin(); iter!=_partition_workers.end(); ++iter)
+        iter->second->stop();
+    (void)commit_processed(true);
+    for (iter=_partition_workers.begin(); iter!=_partition_workers.end(); ++iter)
+        delete iter->second;
+    _partition_workers.clear();
+}
+
+int CKafkaConsumer::consume_messages(int batch_size, int timeout_ms, std::vector<RdKafka::Message*>* messages)
+{
+    const int64_t end = int64_t(sys::CDatetimeUtils::get_current_milliseconds() + timeout_ms);
+    int64_t remaining_timeout = timeout_ms;
+    int num_messages = 0;
+    messages->reserve(messages->size() + batch_size);
+
+    for (int i=0; i<batch_size; ++i)
+    {
+        RdKafka::Message* message = _consumer->consume(remaining_timeout);
+        const RdKafka::ErrorCode errcode = message->err();
+
+        if (RdKafka::ERR_NO_ERROR == errcode)
+        {
+            messages->push_back(message);
+            ++num_messages;
+            remaining_timeout = end - int64_t(sys::CDatetimeUtils::get_current_milliseconds());
+            if (remaining_timeout <= 0)
+                break;
+        }
+        else
+        {
+            if ((RdKafka::ERR__TIMED_OUT == errcode) ||
+                (RdKafka::ERR__PARTITION_EOF == errcode))
+            {
+                MYLOG_DETAIL("Consume topic://%s error: (%d)%s.\n", _topic_str.c_str(), (int)errcode, message->errstr().c_str());
+            }
+            else
+            {
+                MYLOG_ERROR("Consume topic://%s error: (%d)%s.\n", _topic_str.c_str(), (int)errcode, message->errstr().c_str());
+            }
+
+            delete message;
+            break;
+        }
+    }
+
+    return num_messages;
+}
+
+// 提交各分区工作线程已处理完的offset，提交的是下一条待消费消息的offset
+int CKafkaConsumer::commit_processed(bool sync)
+{
+    std::vector<RdKafka::TopicPartition*> offsets;
+    for (std::map<int32_t, CKafkaPartitionWorker*>::iterator iter=_partition_workers.begin(); iter!=_partition_workers.end(); ++iter)
+    {
+        int64_t offset;
+        if (iter->second->pop_processed_offset(&offset))
+            offsets.push_back(RdKafka::TopicPartition::create(_topic_str, iter->first, offset+1));
+    }
+    if (offsets.empty())
+        return int(RdKafka::ERR_NO_ERROR);
+
+    const RdKafka::ErrorCode errcode = sync? _consumer->commitSync(offsets): _consumer->commitAsync(offsets);
+    if (errcode != RdKafka::ERR_NO_ERROR)
+    {
+        MYLOG_ERROR("Commit topic://%s error: (%d)%s.\n", _topic_str.c_str(), (int)errcode, RdKafka::err2str(errcode).c_str());
+    }
+
+    RdKafka::TopicPartition::destroy(offsets);
+    return int(errcode);
+}
+
 int CKafkaConsumer::sync_commit()
 {
     return int(_consumer->commitSync());
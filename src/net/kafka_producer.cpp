@@ -1,7 +1,11 @@
 // Writed by yijian on 2018/11/18
 #include "net/kafka_producer.h"
+#include "sys/metrics.h"
 #include "utils/string_utils.h"
+#include <string.h>
+#include <time.h>
 #if MOOON_HAVE_LIBRDKAFKA==1
+#include <librdkafka/rdkafka.h>
 NET_NAMESPACE_BEGIN
 
 class DefDeliveryReportImpl: public RdKafka::DeliveryReportCb
@@ -31,6 +35,72 @@ private:
     virtual int32_t partitioner_cb (const RdKafka::Topic *topic, const std::string *key, int32_t partition_cnt, void *msg_opaque);
 };
 
+// 统计递送报告，调用produce_nocopy的释放回调，再转给用户的dr_cb
+class CDeliveryReportDispatcher: public RdKafka::DeliveryReportCb
+{
+public:
+    CDeliveryReportDispatcher(CKafkaProducer* producer)
+        : _producer(producer)
+    {
+    }
+
+private:
+    virtual void dr_cb (RdKafka::Message &message)
+    {
+        _producer->on_delivery(message);
+    }
+
+private:
+    CKafkaProducer* _producer;
+};
+
+// 作为每个消息的msg_opaque
+struct CKafkaProducer::Tracker
+{
+    int32_t partition;   // produce时指定的分区
+    uint64_t enqueue_us; // 入队时的单调时钟微秒数
+    kafka_release_t release;
+    void* context;
+};
+
+static uint64_t get_monotonic_microseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
+// 所有生产者共用的度量，delivery_latency_ns为从入队到收到递送报告的时长
+static mooon::sys::CCounter* get_delivered_counter()
+{
+    static mooon::sys::CCounter* counter = mooon::sys::CMetricsRegistry::get_singleton()->get_counter("kafka.delivered");
+    return counter;
+}
+
+static mooon::sys::CCounter* get_delivery_error_counter()
+{
+    static mooon::sys::CCounter* counter = mooon::sys::CMetricsRegistry::get_singleton()->get_counter("kafka.delivery_error");
+    return counter;
+}
+
+static mooon::sys::CCounter* get_spooled_counter()
+{
+    static mooon::sys::CCounter* counter = mooon::sys::CMetricsRegistry::get_singleton()->get_counter("kafka.spooled");
+    return counter;
+}
+
+static mooon::sys::CCounter* get_replayed_counter()
+{
+    static mooon::sys::CCounter* counter = mooon::sys::CMetricsRegistry::get_singleton()->get_counter("kafka.replayed");
+    return counter;
+}
+
+static mooon::sys::CLatencyHistogram* get_delivery_latency_histogram()
+{
+    static mooon::sys::CLatencyHistogram* histogram = mooon::sys::CMetricsRegistry::get_singleton()->get_histogram("kafka.delivery_latency_ns");
+    return histogram;
+}
+
 void DefDeliveryReportImpl::dr_cb (RdKafka::Message &message)
 {
     // delivery_callback: (-192)Local: Message timed out
@@ -59,6 +129,8 @@ int32_t DefPartitionerImpl::partitioner_cb (const RdKafka::Topic *topic, const s
 // CKafkaProducer
 
 CKafkaProducer::CKafkaProducer(RdKafka::DeliveryReportCb* dr_cb, RdKafka::EventCb* event_cb, RdKafka::PartitionerCb* partitioner_cb)
+    : _produced_number(0), _produce_error_number(0), _spooled_number(0), _replayed_number(0),
+      _spool(NULL), _replay_batch(0), _retry_interval_ms(0), _last_delivery_error_us(0)
 {
     // KafkaConsumer::create和Producer::create
     // 调用HandleImpl::set_common_config注册下列回调。
@@ -80,6 +152,50 @@ CKafkaProducer::CKafkaProducer(RdKafka::DeliveryReportCb* dr_cb, RdKafka::EventC
         _partitioner_cb.reset(new DefPartitionerImpl);
     else
         _partitioner_cb.reset(partitioner_cb);
+
+    _dr_dispatcher.reset(new CDeliveryReportDispatcher(this));
+}
+
+// 销毁前应调用flush，否则未递送的消息不再有递送报告，produce_nocopy的release也不会被调用
+CKafkaProducer::~CKafkaProducer()
+{
+    // 先于_dr_dispatcher等回调对象销毁
+    _topic.reset();
+    _producer.reset();
+}
+
+void CKafkaProducer::set_global_config(const std::string& name, const std::string& value)
+{
+    _global_configs[name] = value;
+}
+
+void CKafkaProducer::set_topic_config(const std::string& name, const std::string& value)
+{
+    _topic_configs[name] = value;
+}
+
+void CKafkaProducer::set_batching(int linger_ms, int batch_num_messages, const std::string& compression_codec, int queue_max_messages)
+{
+    set_global_config("queue.buffering.max.ms", mooon::utils::CStringUtils::int_tostring(linger_ms));
+    set_global_config("batch.num.messages", mooon::utils::CStringUtils::int_tostring(batch_num_messages));
+    set_global_config("compression.codec", compression_codec);
+    set_global_config("queue.buffering.max.messages", mooon::utils::CStringUtils::int_tostring(queue_max_messages));
+}
+
+bool CKafkaProducer::set_configs(const std::map<std::string, std::string>& configs, RdKafka::Conf* conf, std::string* errmsg)
+{
+    for (std::map<std::string, std::string>::const_iterator iter=configs.begin(); iter!=configs.end(); ++iter)
+    {
+        std::string errmsg_;
+        if (conf->set(iter->first, iter->second, errmsg_) != RdKafka::Conf::CONF_OK)
+        {
+            if (errmsg != NULL)
+                *errmsg = mooon::utils::CStringUtils::format_string("set %s://%s error: %s", iter->first.c_str(), iter->second.c_str(), errmsg_.c_str());
+            return false;
+        }
+    }
+
+    return true;
 }
 
 bool CKafkaProducer::init(const std::string& brokers_str, const std::string& topic_str, std::string* errmsg)
@@ -119,8 +235,12 @@ bool CKafkaProducer::init(const std::string& brokers_str, const std::string& top
             break;
         }
 
-        // dr_cb
-        ret = _global_conf->set("dr_cb", _dr_cb.get(), errmsg_);
+        if (!set_configs(_global_configs, _global_conf.get(), errmsg)
+         || !set_configs(_topic_configs, _topic_conf.get(), errmsg))
+            break;
+
+        // dr_cb，由_dr_dispatcher统计后转给_dr_cb
+        ret = _global_conf->set("dr_cb", _dr_dispatcher.get(), errmsg_);
         if (ret != RdKafka::Conf::CONF_OK)
         {
             if (errmsg != NULL)
@@ -174,14 +294,28 @@ bool CKafkaProducer::init(const std::string& brokers_str, const std::string& top
 bool CKafkaProducer::produce(const std::string& key, const std::string& log, int32_t partition, int* errcode, std::string* errmsg)
 {
     RdKafka::ErrorCode errcode_;
-    void* msg_opaque = NULL;
 
+    // 有积压时直接暂存，先暂存的先重放
+    if (has_spooled() && spool_message(key.data(), key.size(), log.data(), log.size()))
+    {
+        timed_poll(0);
+        if (errcode != NULL)
+            *errcode = 0;
+        if (errmsg != NULL)
+            *errmsg = "SPOOLED";
+        return true;
+    }
+
+    Tracker* msg_opaque = new_tracker(partition, NULL, NULL);
     if (key.empty())
         errcode_ = _producer->produce(
                 _topic.get(), partition, RdKafka::Producer::RK_MSG_COPY,  (void*)log.data(), log.size(), NULL, 0, msg_opaque);
     else
         errcode_ = _producer->produce(
                 _topic.get(), partition, RdKafka::Producer::RK_MSG_COPY,  (void*)log.data(), log.size(), (void*)key.data(), key.size(), msg_opaque);
+    on_produce(msg_opaque, errcode_);
+    if ((RdKafka::ERR__QUEUE_FULL == errcode_) && (_spool != NULL) && spool_message(key.data(), key.size(), log.data(), log.size()))
+        errcode_ = RdKafka::ERR_NO_ERROR;
     timed_poll(0);
 
     // log可能是二进制数据，这里无法解析，所以并不适合记录到日志文件中
@@ -206,32 +340,41 @@ bool CKafkaProducer::produce(const std::string& key, const std::string& log, int
 
 int CKafkaProducer::produce_batch(const std::string& key, const std::vector<std::string>& logs, int32_t partition, int* errcode, std::string* errmsg)
 {
+    std::vector<rd_kafka_message_t> messages(logs.size());
     int num_logs = 0;
 
     timed_poll(0);
-    for (int i=0; i<int(logs.size()); ++i)
+    if (logs.empty())
+        return 0;
+
+    memset(&messages[0], 0, sizeof(rd_kafka_message_t)*messages.size());
+    for (std::vector<std::string>::size_type i=0; i<logs.size(); ++i)
     {
-        const std::string& log = logs[i];
-        RdKafka::ErrorCode errcode_;
-        void* msg_opaque = NULL;
-
-        // 入队（发送队列）有两种方式：
-        // 1) 非阻塞方式，如果队列满返回错误代码RD_KAFKA_RESP_ERR__QUEUE_FULL
-        // 2) 阻塞方式，需指定RdKafka::RK_MSG_BLOCK
-        if (key.empty())
-            errcode_ = _producer->produce(
-                    _topic.get(), partition, RdKafka::Producer::RK_MSG_COPY,  (void*)log.data(), log.size(), NULL, 0, msg_opaque);
-        else
-            errcode_ = _producer->produce(
-                    _topic.get(), partition, RdKafka::Producer::RK_MSG_COPY,  (void*)log.data(), log.size(), (void*)key.data(), key.size(), msg_opaque);
+        messages[i].payload = const_cast<char*>(logs[i].data());
+        messages[i].len = logs[i].size();
+        if (!key.empty())
+        {
+            messages[i].key = const_cast<char*>(key.data());
+            messages[i].key_len = key.size();
+        }
+        messages[i]._private = new_tracker(partition, NULL, NULL); // 即msg_opaque
+    }
 
-        if (RdKafka::ERR_NO_ERROR == errcode_)
+    // 入队方式同produce，失败的消息在各自的err中
+    (void)rd_kafka_produce_batch(_topic->c_ptr(), partition, RD_KAFKA_MSG_F_COPY, &messages[0], static_cast<int>(messages.size()));
+    if (errcode != NULL)
+        *errcode = 0;
+    if (errmsg != NULL)
+        *errmsg = "SUCCESS";
+    for (std::vector<rd_kafka_message_t>::size_type i=0; i<messages.size(); ++i)
+    {
+        const RdKafka::ErrorCode errcode_ = static_cast<RdKafka::ErrorCode>(messages[i].err);
+
+        on_produce(static_cast<Tracker*>(messages[i]._private), errcode_);
+        if ((RdKafka::ERR_NO_ERROR == errcode_)
+         || ((RdKafka::ERR__QUEUE_FULL == errcode_) && (_spool != NULL) && spool_message(key.data(), key.size(), logs[i].data(), logs[i].size())))
         {
             ++num_logs;
-            if (errcode != NULL)
-                *errcode = 0;
-            if (errmsg != NULL)
-                *errmsg = "SUCCESS";
         }
         else
         {
@@ -239,16 +382,246 @@ int CKafkaProducer::produce_batch(const std::string& key, const std::vector<std:
                 *errcode = errcode_;
             if (errmsg != NULL)
                 *errmsg = err2str(errcode_);
-            if (errcode_ == RdKafka::ERR__QUEUE_FULL)
-                timed_poll(0);
-            break;
         }
     }
 
-
+    // 队列满时触发发送
+    if (num_logs < static_cast<int>(logs.size()))
+        timed_poll(0);
     return num_logs;
 }
 
+bool CKafkaProducer::produce_nocopy(const std::string& key, const char* log, size_t log_size, kafka_release_t release, void* context,
+                                    int32_t partition, int* errcode, std::string* errmsg)
+{
+    RdKafka::ErrorCode errcode_;
+    Tracker* msg_opaque = new_tracker(partition, release, context);
+
+    // 不指定RK_MSG_COPY和RK_MSG_FREE，librdkafka直接引用log
+    if (key.empty())
+        errcode_ = _producer->produce(
+                _topic.get(), partition, 0, const_cast<char*>(log), log_size, NULL, 0, msg_opaque);
+    else
+        errcode_ = _producer->produce(
+                _topic.get(), partition, 0, const_cast<char*>(log), log_size, (void*)key.data(), key.size(), msg_opaque);
+    on_produce(msg_opaque, errcode_);
+    timed_poll(0);
+
+    if (RdKafka::ERR_NO_ERROR == errcode_)
+    {
+        if (errcode != NULL)
+            *errcode = 0;
+        if (errmsg != NULL)
+            *errmsg = "SUCCESS";
+        return true;
+    }
+    else
+    {
+        if (errcode != NULL)
+            *errcode = errcode_;
+        if (errmsg != NULL)
+            *errmsg = err2str(errcode_);
+        return false;
+    }
+}
+
+void CKafkaProducer::set_spool(mooon::sys::CDiskQueue* spool, int replay_batch, int retry_interval_ms)
+{
+    _spool = spool;
+    _replay_batch = (replay_batch > 0)? replay_batch: 1;
+    _retry_interval_ms = retry_interval_ms;
+}
+
+bool CKafkaProducer::spool(const std::string& key, const std::string& log)
+{
+    return (_spool != NULL) && spool_message(key.data(), key.size(), log.data(), log.size());
+}
+
+bool CKafkaProducer::has_spooled() const
+{
+    if (NULL == _spool)
+        return false;
+
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_spool_lock);
+    return !_spool->empty();
+}
+
+void CKafkaProducer::get_stats(KafkaProducerStats* stats) const
+{
+    {
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_stats_lock);
+        stats->produced_number = _produced_number;
+        stats->produce_error_number = _produce_error_number;
+        stats->spooled_number = _spooled_number;
+        stats->replayed_number = _replayed_number;
+        stats->partitions = _partition_stats;
+    }
+
+    stats->inflight_number = 0;
+    for (std::map<int32_t, KafkaPartitionStats>::const_iterator iter=stats->partitions.begin(); iter!=stats->partitions.end(); ++iter)
+        stats->inflight_number += iter->second.inflight_number;
+    stats->queue_depth = (_producer.get() != NULL)? _producer->outq_len(): 0;
+}
+
+// 入队前计入在途，入队失败再减去，这样即使在其它线程poll，递送报告也总是在计入之后
+CKafkaProducer::Tracker* CKafkaProducer::new_tracker(int32_t partition, kafka_release_t release, void* context)
+{
+    Tracker* tracker = new Tracker;
+    tracker->partition = partition;
+    tracker->enqueue_us = get_monotonic_microseconds();
+    tracker->release = release;
+    tracker->context = context;
+
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_stats_lock);
+    ++_partition_stats[partition].inflight_number;
+    return tracker;
+}
+
+void CKafkaProducer::on_produce(Tracker* tracker, RdKafka::ErrorCode errcode)
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_stats_lock);
+    if (RdKafka::ERR_NO_ERROR == errcode)
+    {
+        ++_produced_number;
+    }
+    else
+    {
+        ++_produce_error_number;
+        --_partition_stats[tracker->partition].inflight_number;
+        delete tracker;
+    }
+}
+
+void CKafkaProducer::on_delivery(RdKafka::Message& message)
+{
+    Tracker* tracker = static_cast<Tracker*>(message.msg_opaque());
+
+    if (tracker != NULL)
+    {
+        const uint64_t latency_us = get_monotonic_microseconds() - tracker->enqueue_us;
+        get_delivery_latency_histogram()->record(latency_us * 1000);
+        if (RdKafka::ERR_NO_ERROR == message.err())
+            get_delivered_counter()->inc();
+        else
+            get_delivery_error_counter()->inc();
+        {
+            mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_stats_lock);
+            --_partition_stats[tracker->partition].inflight_number;
+
+            KafkaPartitionStats& partition_stats = _partition_stats[message.partition()];
+            if (RdKafka::ERR_NO_ERROR == message.err())
+            {
+                ++partition_stats.delivered_number;
+                partition_stats.delivered_bytes += message.len();
+            }
+            else
+            {
+                ++partition_stats.error_number;
+            }
+            partition_stats.total_latency_us += latency_us;
+            if (latency_us > partition_stats.max_latency_us)
+                partition_stats.max_latency_us = latency_us;
+        }
+
+        // 消息过大时重放也不会成功
+        if ((message.err() != RdKafka::ERR_NO_ERROR) && (_spool != NULL))
+        {
+            _last_delivery_error_us = get_monotonic_microseconds();
+            if (message.err() != RdKafka::ERR_MSG_SIZE_TOO_LARGE)
+                (void)spool_message(message.key_pointer(), message.key_len(), message.payload(), message.len());
+        }
+        if (tracker->release != NULL)
+            (*tracker->release)(static_cast<const char*>(message.payload()), message.len(), tracker->context);
+        delete tracker;
+    }
+
+    _dr_cb->dr_cb(message);
+}
+
+bool CKafkaProducer::spool_message(const void* key, size_t key_size, const void* log, size_t log_size)
+{
+    try
+    {
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_spool_lock);
+        const uint32_t key_size_ = static_cast<uint32_t>(key_size);
+        char* record = _spool->reserve(static_cast<uint32_t>(sizeof(key_size_) + key_size + log_size));
+        if (NULL == record)
+            return false;
+
+        memcpy(record, &key_size_, sizeof(key_size_));
+        if (key_size > 0)
+            memcpy(record + sizeof(key_size_), key, key_size);
+        memcpy(record + sizeof(key_size_) + key_size, log, log_size);
+        _spool->commit(static_cast<uint32_t>(sizeof(key_size_) + key_size + log_size));
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("spool to topic://%s failed: %s\n", _topic_str.c_str(), ex.str().c_str());
+        return false;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        MYLOG_ERROR("spool to topic://%s failed: %s\n", _topic_str.c_str(), ex.str().c_str());
+        return false;
+    }
+
+    get_spooled_counter()->inc();
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_stats_lock);
+    ++_spooled_number;
+    return true;
+}
+
+// 按spool中的顺序重新入队，入队成功的才出队，重放的消息再次递送失败时重新写入spool
+void CKafkaProducer::replay_spool()
+{
+    if ((NULL == _spool)
+     || (get_monotonic_microseconds() - _last_delivery_error_us < static_cast<uint64_t>(_retry_interval_ms) * 1000))
+        return;
+
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_spool_lock);
+    std::vector<std::string_view> records;
+    size_t num_replayed = 0;
+    size_t num_popped = 0;
+    if (_spool->empty())
+        return;
+    _spool->peek(&records, _replay_batch);
+    for (; num_popped<records.size(); ++num_popped)
+    {
+        const std::string_view& record = records[num_popped];
+        uint32_t key_size = 0;
+        if (record.size() >= sizeof(key_size))
+            memcpy(&key_size, record.data(), sizeof(key_size));
+        if (record.size() < sizeof(key_size) + key_size)
+        {
+            MYLOG_ERROR("invalid spooled record of topic://%s: %zu bytes\n", _topic_str.c_str(), record.size());
+            continue;
+        }
+
+        const char* key = record.data() + sizeof(key_size);
+        const char* log = key + key_size;
+        const size_t log_size = record.size() - sizeof(key_size) - key_size;
+        Tracker* msg_opaque = new_tracker(RdKafka::Topic::PARTITION_UA, NULL, NULL);
+        const RdKafka::ErrorCode errcode = _producer->produce(
+                _topic.get(), RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY,
+                const_cast<char*>(log), log_size, (0 == key_size)? NULL: key, key_size, msg_opaque);
+        on_produce(msg_opaque, errcode);
+        if (RdKafka::ERR__QUEUE_FULL == errcode)
+            break;
+        if (RdKafka::ERR_NO_ERROR == errcode)
+            ++num_replayed;
+        else
+            MYLOG_ERROR("replay to topic://%s failed: (%d)%s\n", _topic_str.c_str(), errcode, err2str(errcode).c_str());
+    }
+
+    _spool->pop(num_popped);
+    if (num_replayed > 0)
+    {
+        get_replayed_counter()->inc(num_replayed);
+        mooon::sys::LockHelper<mooon::sys::CLock> stats_lock_helper(_stats_lock);
+        _replayed_number += num_replayed;
+    }
+}
+
 // rd_kafka_poll_cb:
 // int rd_kafka_poll (rd_kafka_t *rk, int timeout_ms) {
 //        return rd_kafka_q_serve(rk->rk_rep, timeout_ms, 0,
@@ -288,6 +661,7 @@ int CKafkaProducer::timed_poll(int timeout_ms)
     // rd_kafka_q_enq/rdkafka_queue.h
     // -> rd_kafka_q_enq1/rdkafka_queue.h(Enqueue rko either at head or tail of rkq)
     // -> rd_kafka_q_enq0(Low-level unprotected enqueue)
+    replay_spool();
     return _producer->poll(timeout_ms);
 }
 
@@ -321,5 +695,186 @@ int CKafkaProducer::flush(int timeout_ms)
 // 这些线程（rd_kafka_broker_thread_main）是在调用KafkaConsumer::create和Producer::create时创建，
 // 会为每个broker均创建一个rd_kafka_broker_thread_main线程。
 
+////////////////////////////////////////////////////////////////////////////////
+// CAsyncKafkaProducer
+
+static mooon::sys::CCounter* get_async_spilled_counter()
+{
+    static mooon::sys::CCounter* counter = mooon::sys::CMetricsRegistry::get_singleton()->get_counter("kafka.async_spilled");
+    return counter;
+}
+
+static mooon::sys::CCounter* get_async_dropped_counter()
+{
+    static mooon::sys::CCounter* counter = mooon::sys::CMetricsRegistry::get_singleton()->get_counter("kafka.async_dropped");
+    return counter;
+}
+
+static mooon::sys::CGauge* get_async_buffered_gauge()
+{
+    static mooon::sys::CGauge* gauge = mooon::sys::CMetricsRegistry::get_singleton()->get_gauge("kafka.async_buffered_bytes");
+    return gauge;
+}
+
+static mooon::sys::CLatencyHistogram* get_async_queue_latency_histogram()
+{
+    static mooon::sys::CLatencyHistogram* histogram = mooon::sys::CMetricsRegistry::get_singleton()->get_histogram("kafka.async_queue_latency_ns");
+    return histogram;
+}
+
+CAsyncKafkaProducer::CAsyncKafkaProducer(CKafkaProducer* producer, size_t memory_budget)
+    : _producer(producer), _memory_budget(memory_budget), _poll_interval_ms(10), _thread(NULL),
+      _buffered_bytes(0), _spilling(false), _stop(false),
+      _accepted_number(0), _spilled_number(0), _dropped_number(0), _max_buffered_bytes(0),
+      _total_queue_latency_us(0), _max_queue_latency_us(0)
+{
+}
+
+CAsyncKafkaProducer::~CAsyncKafkaProducer()
+{
+    stop(0);
+}
+
+void CAsyncKafkaProducer::start(int poll_interval_ms)
+{
+    _poll_interval_ms = (poll_interval_ms > 0)? poll_interval_ms: 1;
+    _stop = false;
+    _thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&CAsyncKafkaProducer::run, this));
+}
+
+void CAsyncKafkaProducer::stop(int flush_timeout_ms)
+{
+    if (NULL == _thread)
+        return;
+
+    {
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+        _stop = true;
+        _event.signal();
+    }
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+
+    // 后台线程退出前已将内存中的消息都交给了CKafkaProducer
+    if (flush_timeout_ms > 0)
+        (void)_producer->flush(flush_timeout_ms);
+}
+
+bool CAsyncKafkaProducer::produce(const std::string& key, const std::string& log)
+{
+    const size_t size = key.size() + log.size();
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+
+    if (!_spilling && (_buffered_bytes + size <= _memory_budget))
+    {
+        _messages.push_back(Message());
+        Message& message = _messages.back();
+        message.key = key;
+        message.log = log;
+        message.accepted_us = get_monotonic_microseconds();
+        _buffered_bytes += size;
+        if (_buffered_bytes > _max_buffered_bytes)
+            _max_buffered_bytes = _buffered_bytes;
+        ++_accepted_number;
+        if (1 == _messages.size())
+            _event.signal();
+        return true;
+    }
+
+    // 在锁内写spool，使溢出的消息和之后的消息保持顺序，只是复制到映射区，不访问网络
+    _spilling = true;
+    if (_producer->spool(key, log))
+    {
+        get_async_spilled_counter()->inc();
+        ++_accepted_number;
+        ++_spilled_number;
+        return true;
+    }
+
+    get_async_dropped_counter()->inc();
+    ++_dropped_number;
+    return false;
+}
+
+void CAsyncKafkaProducer::get_stats(AsyncKafkaProducerStats* stats) const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    stats->accepted_number = _accepted_number;
+    stats->spilled_number = _spilled_number;
+    stats->dropped_number = _dropped_number;
+    stats->buffered_number = _messages.size();
+    stats->buffered_bytes = _buffered_bytes;
+    stats->max_buffered_bytes = _max_buffered_bytes;
+    stats->total_queue_latency_us = _total_queue_latency_us;
+    stats->max_queue_latency_us = _max_queue_latency_us;
+}
+
+void CAsyncKafkaProducer::run()
+{
+    while (true)
+    {
+        std::deque<Message> messages;
+        bool stop;
+        {
+            mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+            if (_messages.empty() && !_stop)
+                (void)_event.timed_wait(_lock, static_cast<uint32_t>(_poll_interval_ms));
+            messages.swap(_messages);
+            stop = _stop;
+        }
+
+        produce_messages(&messages);
+        (void)_producer->timed_poll(0);
+        {
+            // spool重放完后，新的消息重新进入内存
+            mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+            if (_spilling && !_producer->has_spooled())
+                _spilling = false;
+            get_async_buffered_gauge()->set(static_cast<int64_t>(_buffered_bytes));
+            if (stop && _messages.empty())
+                break;
+        }
+    }
+}
+
+void CAsyncKafkaProducer::produce_messages(std::deque<Message>* messages)
+{
+    size_t bytes = 0;
+    uint64_t total_latency_us = 0;
+    uint64_t max_latency_us = 0;
+
+    for (std::deque<Message>::iterator iter=messages->begin(); iter!=messages->end(); ++iter)
+    {
+        const Message& message = *iter;
+        const uint64_t latency_us = get_monotonic_microseconds() - message.accepted_us;
+        int errcode = 0;
+        std::string errmsg;
+
+        get_async_queue_latency_histogram()->record(latency_us * 1000);
+        total_latency_us += latency_us;
+        if (latency_us > max_latency_us)
+            max_latency_us = latency_us;
+        bytes += message.key.size() + message.log.size();
+
+        // 没有spool时队列满则等待发送，这期间内存满，produce溢出或丢弃，停止时不再等待
+        while (!_producer->produce(message.key, message.log, RdKafka::Topic::PARTITION_UA, &errcode, &errmsg))
+        {
+            if ((errcode != RdKafka::ERR__QUEUE_FULL) || _stop)
+            {
+                MYLOG_ERROR("async produce failed: (%d)%s\n", errcode, errmsg.c_str());
+                break;
+            }
+            (void)_producer->timed_poll(_poll_interval_ms);
+        }
+    }
+
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    _buffered_bytes -= bytes;
+    _total_queue_latency_us += total_latency_us;
+    if (max_latency_us > _max_queue_latency_us)
+        _max_queue_latency_us = max_latency_us;
+}
+
 NET_NAMESPACE_END
 #endif // MOOON_HAVE_LIBRDKAFKA
@@ -62,7 +62,11 @@
 #include "mooon/net/config.h"
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sstream>
 #include <mooon/net/utils.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/deadline.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/string_utils.h>
 #include <sys/select.h>
@@ -72,6 +76,7 @@
 #include <unistd.h>
 #if MOOON_HAVE_LIBSSH2 == 1
 #include <libssh2.h>
+#include <libssh2_sftp.h>
 #endif // MOOON_HAVE_LIBSSH2
 
 NET_NAMESPACE_BEGIN
@@ -170,6 +175,213 @@ void CLibssh2::remotely_execute(
     *exitcode = close_ssh_channel(channel, exitsignal, errmsg);
 }
 
+// 并发执行时一条命令所处的阶段
+enum ChannelStage
+{
+    stage_waiting, // 等待打开通道
+    stage_opening, // 正在打开通道，同一会话同时只能有一个
+    stage_exec,
+    stage_read,
+    stage_close,
+    stage_free,
+    stage_done
+};
+
+struct ChannelTask
+{
+    ChannelStage stage;
+    LIBSSH2_CHANNEL* channel;
+};
+
+void CLibssh2::remotely_execute(const std::vector<std::string>& commands, std::vector<struct ExecuteResult>* results, int max_channels)
+{
+    LIBSSH2_SESSION* session = static_cast<LIBSSH2_SESSION*>(_session);
+    const int blocking = libssh2_session_get_blocking(session);
+    std::vector<struct ChannelTask> tasks(commands.size());
+    size_t num_done = 0;
+    size_t next = 0; // 下一条待打开通道的命令
+    int num_channels = 0; // 已打开或正在打开的通道数
+    bool opening = false;
+
+    results->clear();
+    results->resize(commands.size());
+    for (std::vector<struct ChannelTask>::size_type i=0; i<tasks.size(); ++i)
+    {
+        tasks[i].stage = stage_waiting;
+        tasks[i].channel = NULL;
+    }
+
+    libssh2_session_set_blocking(session, 0);
+    try
+    {
+        while (num_done < tasks.size())
+        {
+            bool progress = false;
+
+            if (!opening && (next < tasks.size()) && (num_channels < max_channels))
+            {
+                tasks[next++].stage = stage_opening;
+                opening = true;
+                ++num_channels;
+                progress = true;
+            }
+
+            for (std::vector<struct ChannelTask>::size_type i=0; i<tasks.size(); ++i)
+            {
+                struct ChannelTask& task = tasks[i];
+                struct ExecuteResult& result = (*results)[i];
+                int errcode;
+
+                switch (task.stage)
+                {
+                case stage_opening:
+                    task.channel = libssh2_channel_open_session(session);
+                    if (task.channel != NULL)
+                    {
+                        task.stage = stage_exec;
+                        opening = false;
+                        progress = true;
+                    }
+                    else if ((errcode = get_session_errcode()) != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        THROW_EXCEPTION(get_session_errmsg(), errcode);
+                    }
+                    break;
+
+                case stage_exec:
+                    errcode = libssh2_channel_exec(task.channel, commands[i].c_str());
+                    if (0 == errcode)
+                    {
+                        task.stage = stage_read;
+                        progress = true;
+                    }
+                    else if (errcode != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        // 如通道请求被拒绝，只影响这一条命令
+                        result.errmsg = get_session_errmsg();
+                        task.stage = stage_close;
+                        progress = true;
+                    }
+                    break;
+
+                case stage_read:
+                    for (;;)
+                    {
+                        char buffer[4096];
+                        const ssize_t bytes = libssh2_channel_read(task.channel, buffer, sizeof(buffer));
+                        if (bytes > 0)
+                        {
+                            result.output.append(buffer, bytes);
+                            progress = true;
+                            continue;
+                        }
+                        else if ((bytes < 0) && (bytes != LIBSSH2_ERROR_EAGAIN))
+                        {
+                            THROW_EXCEPTION(get_session_errmsg(), static_cast<int>(bytes));
+                        }
+
+                        // 同单命令的remotely_execute只取标准输出，
+                        // 但标准错误也须读走，否则通道窗口被占满后命令会卡住
+                        while (libssh2_channel_read_stderr(task.channel, buffer, sizeof(buffer)) > 0);
+                        if (libssh2_channel_eof(task.channel))
+                        {
+                            task.stage = stage_close;
+                            progress = true;
+                        }
+                        break;
+                    }
+                    break;
+
+                case stage_close:
+                    errcode = libssh2_channel_close(task.channel);
+                    if (0 == errcode)
+                    {
+                        char* exitsignal = NULL;
+                        char* errmsg = NULL;
+
+                        if (result.errmsg.empty())
+                        {
+                            result.exitcode = libssh2_channel_get_exit_status(task.channel);
+                            libssh2_channel_get_exit_signal(task.channel, &exitsignal, NULL, &errmsg, NULL, NULL, NULL);
+                        }
+                        if (exitsignal != NULL)
+                        {
+                            result.exitsignal = exitsignal;
+                            free(exitsignal);
+                        }
+                        if (errmsg != NULL)
+                        {
+                            result.errmsg = errmsg;
+                            free(errmsg);
+                        }
+                        task.stage = stage_free;
+                        progress = true;
+                    }
+                    else if (errcode != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        THROW_EXCEPTION(get_session_errmsg(), errcode);
+                    }
+                    break;
+
+                case stage_free:
+                    errcode = libssh2_channel_free(task.channel);
+                    if (0 == errcode)
+                    {
+                        task.channel = NULL;
+                        task.stage = stage_done;
+                        --num_channels;
+                        ++num_done;
+                        progress = true;
+                    }
+                    else if (errcode != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        THROW_EXCEPTION(get_session_errmsg(), errcode);
+                    }
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            // 所有通道都在等待数据
+            if (!progress && !timedwait_socket())
+            {
+                THROW_SYSCALL_EXCEPTION("channels timeout", ETIMEDOUT, "poll");
+            }
+        }
+    }
+    catch (...)
+    {
+        // 会话已出错，只释放通道的本地资源
+        for (std::vector<struct ChannelTask>::size_type i=0; i<tasks.size(); ++i)
+        {
+            if (tasks[i].channel != NULL)
+                libssh2_channel_free(tasks[i].channel);
+        }
+        libssh2_session_set_blocking(session, blocking);
+        throw;
+    }
+
+    libssh2_session_set_blocking(session, blocking);
+}
+
+bool CLibssh2::is_alive() const
+{
+    if (-1 == _socket_fd)
+        return false;
+
+    // 对端关闭连接时可读，且读到0字节；
+    // 空闲时不应有数据，可读但有数据（如服务端的断开通知）同样视为不可用
+    struct pollfd fds = { _socket_fd, POLLIN, 0 };
+    const int n = poll(&fds, 1, 0);
+    if (0 == n)
+        return true;
+    if (n < 0)
+        return (EINTR == errno);
+    return false;
+}
+
 void CLibssh2::download(const std::string& remote_filepath, std::ostream& out, int64_t* num_bytes)
 {
     struct stat fileinfo;
@@ -256,6 +468,473 @@ void CLibssh2::upload(const std::string& local_filepath, const std::string& remo
     }
 }
 
+void CLibssh2::sftp_download(std::vector<struct SftpTransfer>* transfers, int max_files, size_t buffer_size, sftp_progress_t progress, void* context)
+{
+    sftp_transfer(transfers, true, max_files, buffer_size, progress, context);
+}
+
+void CLibssh2::sftp_upload(std::vector<struct SftpTransfer>* transfers, int max_files, size_t buffer_size, sftp_progress_t progress, void* context)
+{
+    sftp_transfer(transfers, false, max_files, buffer_size, progress, context);
+}
+
+// SFTP传输时一个文件所处的阶段
+enum SftpStage
+{
+    sftp_stage_waiting, // 等待打开
+    sftp_stage_opening, // 正在打开远端文件，同一SFTP会话同时只能有一个
+    sftp_stage_stat,    // 下载时取远端文件的大小，续传时据此确定开始的位置
+    sftp_stage_transfer,
+    sftp_stage_closing,
+    sftp_stage_done
+};
+
+struct SftpTask
+{
+    SftpStage stage;
+    LIBSSH2_SFTP_HANDLE* handle;
+    int local_fd;
+    int filemode;              // 上传时远端文件的权限
+    int64_t local_size;        // 下载时本地文件已有的大小，续传时用到
+    uint64_t start_nanoseconds;
+    std::vector<char> buffer;
+    size_t buffer_bytes;       // 上传时buffer中已从本地文件读出的字节数
+    size_t buffer_offset;      // 上传时buffer中已发送的字节数
+};
+
+// 得到打开、读写或关闭远端文件出错的信息，只影响这一个文件的返回true，
+// SFTP协议层的错误（如文件不存在或无权限）只影响一个文件，其它的为会话级的错误
+static bool get_sftp_file_error(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, std::string* errmsg)
+{
+    char* session_errmsg = NULL;
+    const int errcode = libssh2_session_last_error(session, &session_errmsg, NULL, 0);
+    if (errcode != LIBSSH2_ERROR_SFTP_PROTOCOL)
+        return false;
+
+    *errmsg = utils::CStringUtils::format_string("sftp error %lu: %s", libssh2_sftp_last_error(sftp), session_errmsg);
+    return true;
+}
+
+// 关闭本地文件，结束一个文件的传输，远端的句柄已关闭或未打开
+static void finish_sftp_task(struct SftpTask* task, struct CLibssh2::SftpTransfer* transfer, CLibssh2::sftp_progress_t progress, void* context)
+{
+    task->handle = NULL;
+    if (task->local_fd != -1)
+    {
+        close(task->local_fd);
+        task->local_fd = -1;
+    }
+    std::vector<char>().swap(task->buffer);
+    task->stage = sftp_stage_done;
+    transfer->milliseconds = static_cast<uint32_t>((sys::CClock::get_nanoseconds() - task->start_nanoseconds) / 1000000);
+    if (progress != NULL)
+        (*progress)(*transfer, true, context);
+}
+
+void CLibssh2::sftp_transfer(std::vector<struct SftpTransfer>* transfers, bool is_download, int max_files, size_t buffer_size, sftp_progress_t progress, void* context)
+{
+    LIBSSH2_SESSION* session = static_cast<LIBSSH2_SESSION*>(_session);
+    const int blocking = libssh2_session_get_blocking(session);
+    std::vector<struct SftpTask> tasks(transfers->size());
+    LIBSSH2_SFTP* sftp = NULL;
+    size_t num_done = 0;
+    size_t next = 0; // 下一个待打开的文件
+    int num_files = 0; // 已打开或正在打开的文件数
+    bool opening = false;
+
+    for (std::vector<struct SftpTask>::size_type i=0; i<tasks.size(); ++i)
+    {
+        tasks[i].stage = sftp_stage_waiting;
+        tasks[i].handle = NULL;
+        tasks[i].local_fd = -1;
+        tasks[i].filemode = 0644;
+        tasks[i].local_size = 0;
+        tasks[i].start_nanoseconds = 0;
+        tasks[i].buffer_bytes = 0;
+        tasks[i].buffer_offset = 0;
+        (*transfers)[i].file_size = -1;
+        (*transfers)[i].offset = 0;
+        (*transfers)[i].num_bytes = 0;
+        (*transfers)[i].milliseconds = 0;
+        (*transfers)[i].errmsg.clear();
+    }
+
+    libssh2_session_set_blocking(session, 0);
+    try
+    {
+        while (NULL == (sftp = libssh2_sftp_init(session)))
+        {
+            const int errcode = get_session_errcode();
+            if (errcode != LIBSSH2_ERROR_EAGAIN)
+                THROW_EXCEPTION(get_session_errmsg(), errcode);
+            if (!timedwait_socket())
+                THROW_SYSCALL_EXCEPTION("sftp init timeout", ETIMEDOUT, "poll");
+        }
+
+        while (num_done < tasks.size())
+        {
+            bool progressed = false;
+
+            // 打开远端文件之前先打开本地文件，本地出错的不必占用SFTP会话
+            if (!opening && (next < tasks.size()) && (num_files < max_files))
+            {
+                struct SftpTask& task = tasks[next];
+                struct SftpTransfer& transfer = (*transfers)[next];
+                ++next;
+                progressed = true;
+
+                // 续传时不截断，取得远端文件的大小后再确定从哪里开始
+                const bool resume = is_download && transfer.resume;
+                task.start_nanoseconds = sys::CClock::get_nanoseconds();
+                task.local_fd = is_download
+                              ? open(transfer.local_filepath.c_str(), resume? (O_WRONLY|O_CREAT): (O_WRONLY|O_CREAT|O_TRUNC), 0644)
+                              : open(transfer.local_filepath.c_str(), O_RDONLY);
+                struct stat fileinfo;
+                if ((task.local_fd != -1) && (0 == fstat(task.local_fd, &fileinfo)))
+                {
+                    if (is_download)
+                    {
+                        task.local_size = fileinfo.st_size;
+                    }
+                    else
+                    {
+                        task.filemode = fileinfo.st_mode & 0777;
+                        transfer.file_size = fileinfo.st_size;
+                    }
+                }
+
+                if (-1 == task.local_fd)
+                {
+                    transfer.errmsg = utils::CStringUtils::format_string("open %s failed: %s", transfer.local_filepath.c_str(), strerror(errno));
+                    finish_sftp_task(&task, &transfer, progress, context);
+                    ++num_done;
+                }
+                else
+                {
+                    task.buffer.resize(buffer_size);
+                    task.stage = sftp_stage_opening;
+                    opening = true;
+                    ++num_files;
+                }
+            }
+
+            for (std::vector<struct SftpTask>::size_type i=0; i<tasks.size(); ++i)
+            {
+                struct SftpTask& task = tasks[i];
+                struct SftpTransfer& transfer = (*transfers)[i];
+                ssize_t bytes;
+                int errcode;
+
+                switch (task.stage)
+                {
+                case sftp_stage_opening:
+                    task.handle = libssh2_sftp_open(
+                            sftp, transfer.remote_filepath.c_str(),
+                            is_download? LIBSSH2_FXF_READ: (LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC),
+                            task.filemode);
+                    if (task.handle != NULL)
+                    {
+                        task.stage = is_download? sftp_stage_stat: sftp_stage_transfer;
+                        opening = false;
+                        progressed = true;
+                    }
+                    else if ((errcode = get_session_errcode()) != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        if (!get_sftp_file_error(session, sftp, &transfer.errmsg))
+                            THROW_EXCEPTION(get_session_errmsg(), errcode);
+
+                        finish_sftp_task(&task, &transfer, progress, context);
+                        opening = false;
+                        --num_files;
+                        ++num_done;
+                        progressed = true;
+                    }
+                    break;
+
+                case sftp_stage_stat:
+                    {
+                        LIBSSH2_SFTP_ATTRIBUTES attrs;
+                        errcode = libssh2_sftp_fstat(task.handle, &attrs);
+                        if (LIBSSH2_ERROR_EAGAIN == errcode)
+                            break;
+                        if ((errcode != 0) && !get_sftp_file_error(session, sftp, &transfer.errmsg))
+                            THROW_EXCEPTION(get_session_errmsg(), errcode);
+
+                        if ((0 == errcode) && (attrs.flags & LIBSSH2_SFTP_ATTR_SIZE))
+                            transfer.file_size = static_cast<int64_t>(attrs.filesize);
+                        if (transfer.resume && (task.local_size > 0) && transfer.errmsg.empty())
+                        {
+                            if (transfer.file_size >= task.local_size)
+                            {
+                                // 远端从这里开始读，本地从同一位置接着写
+                                transfer.offset = task.local_size;
+                                libssh2_sftp_seek64(task.handle, static_cast<libssh2_uint64_t>(transfer.offset));
+                            }
+                            else if (-1 == ftruncate(task.local_fd, 0))
+                            {
+                                // 本地的比远端的大（远端文件被重写过）或大小未知，不能续传，重新下载
+                                transfer.errmsg = utils::CStringUtils::format_string("truncate %s failed: %s", transfer.local_filepath.c_str(), strerror(errno));
+                            }
+                        }
+
+                        task.stage = transfer.errmsg.empty()? sftp_stage_transfer: sftp_stage_closing;
+                        progressed = true;
+                    }
+                    break;
+
+                case sftp_stage_transfer:
+                    for (;;)
+                    {
+                        if (is_download)
+                        {
+                            bytes = libssh2_sftp_read(task.handle, &task.buffer[0], task.buffer.size());
+                            if (bytes > 0)
+                            {
+                                // 直接写到文件的对应位置
+                                ssize_t written = 0;
+                                while (written < bytes)
+                                {
+                                    const ssize_t n = pwrite(task.local_fd, &task.buffer[written], bytes-written, transfer.offset+transfer.num_bytes+written);
+                                    if (n > 0)
+                                        written += n;
+                                    else if ((n < 0) && (EINTR == errno))
+                                        continue;
+                                    else
+                                        break;
+                                }
+                                if (written < bytes)
+                                {
+                                    transfer.errmsg = utils::CStringUtils::format_string("write %s failed: %s", transfer.local_filepath.c_str(), strerror(errno));
+                                    task.stage = sftp_stage_closing;
+                                    break;
+                                }
+
+                                transfer.num_bytes += bytes;
+                                if (progress != NULL)
+                                    (*progress)(transfer, false, context);
+                                progressed = true;
+                                continue;
+                            }
+                            if (0 == bytes)
+                            {
+                                task.stage = sftp_stage_closing;
+                                progressed = true;
+                                break;
+                            }
+                        }
+                        else
+                        {
+                            if (task.buffer_offset == task.buffer_bytes)
+                            {
+                                // 上一块已发送完，读下一块
+                                const ssize_t n = pread(task.local_fd, &task.buffer[0], task.buffer.size(), transfer.num_bytes);
+                                if (n <= 0)
+                                {
+                                    if (n < 0)
+                                        transfer.errmsg = utils::CStringUtils::format_string("read %s failed: %s", transfer.local_filepath.c_str(), strerror(errno));
+                                    task.stage = sftp_stage_closing;
+                                    progressed = true;
+                                    break;
+                                }
+
+                                task.buffer_bytes = static_cast<size_t>(n);
+                                task.buffer_offset = 0;
+                            }
+
+                            // 返回EAGAIN后须以相同的数据再次调用
+                            bytes = libssh2_sftp_write(task.handle, &task.buffer[task.buffer_offset], task.buffer_bytes-task.buffer_offset);
+                            if (bytes > 0)
+                            {
+                                task.buffer_offset += bytes;
+                                transfer.num_bytes += bytes;
+                                if (progress != NULL)
+                                    (*progress)(transfer, false, context);
+                                progressed = true;
+                                continue;
+                            }
+                        }
+
+                        if (bytes != LIBSSH2_ERROR_EAGAIN)
+                        {
+                            if (!get_sftp_file_error(session, sftp, &transfer.errmsg))
+                                THROW_EXCEPTION(get_session_errmsg(), static_cast<int>(bytes));
+                            task.stage = sftp_stage_closing;
+                            progressed = true;
+                        }
+                        break;
+                    }
+                    break;
+
+                case sftp_stage_closing:
+                    errcode = libssh2_sftp_close(task.handle);
+                    if (errcode != LIBSSH2_ERROR_EAGAIN)
+                    {
+                        // 如上传时远端磁盘满，到close时才报错
+                        if ((errcode != 0) && !get_sftp_file_error(session, sftp, &transfer.errmsg))
+                            THROW_EXCEPTION(get_session_errmsg(), errcode);
+
+                        finish_sftp_task(&task, &transfer, progress, context);
+                        --num_files;
+                        ++num_done;
+                        progressed = true;
+                    }
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            // 所有文件都在等待数据
+            if (!progressed && !timedwait_socket())
+            {
+                THROW_SYSCALL_EXCEPTION("sftp timeout", ETIMEDOUT, "poll");
+            }
+        }
+
+        int errcode;
+        while ((errcode = libssh2_sftp_shutdown(sftp)) == LIBSSH2_ERROR_EAGAIN)
+        {
+            if (!timedwait_socket())
+                THROW_SYSCALL_EXCEPTION("sftp shutdown timeout", ETIMEDOUT, "poll");
+        }
+        sftp = NULL;
+    }
+    catch (...)
+    {
+        // 会话已出错，此后不再可用，只关闭本地文件，SFTP的句柄随会话一起释放
+        for (std::vector<struct SftpTask>::size_type i=0; i<tasks.size(); ++i)
+        {
+            if (tasks[i].local_fd != -1)
+                close(tasks[i].local_fd);
+        }
+        libssh2_session_set_blocking(session, blocking);
+        throw;
+    }
+
+    libssh2_session_set_blocking(session, blocking);
+}
+
+void CLibssh2::upload(const char* data, size_t size, const std::string& remote_filepath, int filemode, time_t mtime, time_t atime)
+{
+    LIBSSH2_CHANNEL* channel = static_cast<LIBSSH2_CHANNEL*>(open_scp_write_channel(
+        remote_filepath, filemode, size, mtime, atime));
+
+    try
+    {
+        // 整块交给libssh2，由它按通道窗口分包，窗口未满前不必等待对端确认
+        write_channel(channel, data, size);
+        libssh2_channel_send_eof(channel);
+        libssh2_channel_wait_eof(channel);
+        libssh2_channel_wait_closed(channel);
+        libssh2_channel_free(channel);
+    }
+    catch (...)
+    {
+        libssh2_channel_free(channel);
+        throw;
+    }
+}
+
+// 用单引号括起，供远端shell使用
+static std::string shell_quote(const std::string& str)
+{
+    std::string result = "'";
+    for (std::string::size_type i=0; i<str.size(); ++i)
+    {
+        if ('\'' == str[i])
+            result += "'\\''";
+        else
+            result += str[i];
+    }
+
+    return result + "'";
+}
+
+void CLibssh2::upload(const char* data, size_t size, const std::string& remote_filepath, int filemode, utils::compression_t compression, int64_t* num_bytes)
+{
+    if (utils::compression_none == compression)
+    {
+        upload(data, size, remote_filepath, filemode, time(NULL), time(NULL));
+        *num_bytes = static_cast<int64_t>(size);
+    }
+    else
+    {
+        std::string compressed;
+        utils::compress_data(compression, data, size, &compressed);
+        upload_compressed(compressed.data(), compressed.size(), remote_filepath, filemode, compression, num_bytes);
+    }
+}
+
+// 先解压到临时文件，避免留下或读到不完整的文件，pipefail使解压失败时不改名
+void CLibssh2::upload_compressed(const char* compressed_data, size_t compressed_size, const std::string& remote_filepath, int filemode, utils::compression_t compression, int64_t* num_bytes)
+{
+    if ((compression != utils::compression_gzip) && (compression != utils::compression_zstd) && (compression != utils::compression_lz4))
+        THROW_EXCEPTION(utils::CStringUtils::format_string("compression %s can not be decompressed remotely", utils::get_compression_name(compression)), EINVAL);
+
+    int exitcode = 0;
+    std::string exitsignal, errmsg;
+    std::stringstream out;
+    const std::string tmp_filepath = shell_quote(remote_filepath + ".mooon_upload");
+    const std::string command = "bash -c " + shell_quote(utils::CStringUtils::format_string(
+        "set -o pipefail; %s -dc > %s && chmod %o %s && mv -f %s %s",
+        utils::get_compression_name(compression), tmp_filepath.c_str(), static_cast<unsigned int>(filemode & 0777),
+        tmp_filepath.c_str(), tmp_filepath.c_str(), shell_quote(remote_filepath).c_str()));
+
+    remotely_execute(command, compressed_data, compressed_size, out, &exitcode, &exitsignal, &errmsg, num_bytes);
+    if ((exitcode != 0) || !exitsignal.empty())
+        THROW_EXCEPTION(utils::CStringUtils::format_string("%s returned %d: %s%s", command.c_str(), exitcode, exitsignal.c_str(), errmsg.c_str()), exitcode);
+}
+
+void CLibssh2::remotely_execute(
+    const std::string& command, const char* data, size_t size, std::ostream& out,
+    int* exitcode, std::string* exitsignal, std::string* errmsg, int64_t* num_bytes)
+{
+    LIBSSH2_CHANNEL* channel = static_cast<LIBSSH2_CHANNEL*>(open_ssh_channel());
+
+    try
+    {
+        while (true)
+        {
+            int errcode = libssh2_channel_exec(channel, command.c_str());
+            if (0 == errcode)
+            {
+                break;
+            }
+            else if (errcode != LIBSSH2_ERROR_EAGAIN)
+            {
+                THROW_EXCEPTION(get_session_errmsg(), get_session_errcode());
+            }
+            else
+            {
+                sys::CUtils::millisleep(10);
+            }
+        }
+
+        // 先写完标准输入再读输出，命令在读完输入前不宜有大量输出
+        write_channel(channel, data, size);
+        while (true)
+        {
+            int errcode = libssh2_channel_send_eof(channel);
+            if (0 == errcode)
+                break;
+            if (errcode != LIBSSH2_ERROR_EAGAIN)
+                THROW_EXCEPTION(get_session_errmsg(), errcode);
+            if (!timedwait_socket())
+                THROW_SYSCALL_EXCEPTION("channel send eof timeout", ETIMEDOUT, "poll");
+        }
+
+        *num_bytes = read_channel(channel, out, NULL);
+    }
+    catch (...)
+    {
+        *exitcode = close_ssh_channel(channel, exitsignal, errmsg);
+        throw;
+    }
+
+    *exitcode = close_ssh_channel(channel, exitsignal, errmsg);
+}
+
 int CLibssh2::get_session_errcode() const
 {
     LIBSSH2_SESSION* session = static_cast<LIBSSH2_SESSION*>(_session);
@@ -319,8 +998,8 @@ void CLibssh2::create_session(bool nonblocking)
         LIBSSH2_SESSION* session = libssh2_session_init();
         if (nonblocking) // 设置为非阻塞
             libssh2_session_set_blocking(session, 0);
-        else if (_timeout_seconds > 0)
-            libssh2_session_set_timeout(session, _timeout_seconds*1000);
+        else if ((_timeout_seconds > 0) || !sys::CDeadline::get_current().is_infinite())
+            libssh2_session_set_timeout(session, sys::CDeadline::get_current().clamp_milliseconds(_timeout_seconds*1000));
 
         _session = session;
         _socket_fd = socket_fd;
@@ -484,7 +1163,8 @@ bool CLibssh2::timedwait_socket()
     if(direction & LIBSSH2_SESSION_BLOCK_OUTBOUND)
         events_requested |= POLLOUT;
 
-    return CUtils::timed_poll(_socket_fd, events_requested, _timeout_seconds*1000);
+    // 在sys::CDeadlineScope中时以剩余的时间为限，多次等待合起来不超过截止时间
+    return CUtils::timed_poll(_socket_fd, events_requested, static_cast<int>(sys::CDeadline::get_current().clamp_milliseconds(_timeout_seconds*1000)));
 }
 
 void CLibssh2::handshake()
@@ -744,5 +1424,129 @@ void CLibssh2::write_channel(void* channel, const char *buffer, size_t buffer_si
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+CLibssh2Pool::CLibssh2Pool(uint32_t idle_seconds, uint32_t timeout_seconds)
+    : _idle_seconds(idle_seconds), _timeout_seconds(timeout_seconds)
+{
+}
+
+CLibssh2Pool::~CLibssh2Pool()
+{
+    for (std::multimap<std::string, struct IdleSession>::iterator iter=_idle_sessions.begin(); iter!=_idle_sessions.end(); ++iter)
+        delete iter->second.libssh2;
+    for (std::map<CLibssh2*, std::string>::iterator iter=_busy_sessions.begin(); iter!=_busy_sessions.end(); ++iter)
+        delete iter->first;
+}
+
+CLibssh2* CLibssh2Pool::get(const std::string& ip, uint16_t port, const std::string& username, const std::string& password, bool* reused)
+{
+    const std::string key = get_key(ip, port, username);
+    const time_t now = time(NULL);
+    std::vector<CLibssh2*> expired_sessions;
+    CLibssh2* libssh2 = NULL;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        std::pair<std::multimap<std::string, struct IdleSession>::iterator, std::multimap<std::string, struct IdleSession>::iterator> range = _idle_sessions.equal_range(key);
+
+        for (std::multimap<std::string, struct IdleSession>::iterator iter=range.first; iter!=range.second;)
+        {
+            struct IdleSession& idle_session = iter->second;
+
+            if ((idle_session.idle_time + static_cast<time_t>(_idle_seconds) < now) || !idle_session.libssh2->is_alive())
+            {
+                expired_sessions.push_back(idle_session.libssh2);
+                _idle_sessions.erase(iter++);
+            }
+            else if (idle_session.password == password)
+            {
+                libssh2 = idle_session.libssh2;
+                _idle_sessions.erase(iter);
+                _busy_sessions[libssh2] = password;
+                break;
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    // 断开会话可能比较慢，不在锁内进行
+    for (std::vector<CLibssh2*>::size_type i=0; i<expired_sessions.size(); ++i)
+        delete expired_sessions[i];
+    if (reused != NULL)
+        *reused = (libssh2 != NULL);
+    if (libssh2 != NULL)
+        return libssh2;
+
+    libssh2 = new CLibssh2(ip, port, username, password, _timeout_seconds);
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _busy_sessions[libssh2] = password;
+    return libssh2;
+}
+
+void CLibssh2Pool::put(CLibssh2* libssh2, bool broken)
+{
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        std::map<CLibssh2*, std::string>::iterator iter = _busy_sessions.find(libssh2);
+
+        if (iter != _busy_sessions.end())
+        {
+            if (!broken)
+            {
+                struct IdleSession idle_session;
+                idle_session.libssh2 = libssh2;
+                idle_session.password = iter->second;
+                idle_session.idle_time = time(NULL);
+                _idle_sessions.insert(std::make_pair(get_key(libssh2->get_ip(), libssh2->get_port(), libssh2->get_username()), idle_session));
+                _busy_sessions.erase(iter);
+                return;
+            }
+
+            _busy_sessions.erase(iter);
+        }
+    }
+
+    delete libssh2;
+}
+
+void CLibssh2Pool::clear_idle()
+{
+    const time_t now = time(NULL);
+    std::vector<CLibssh2*> expired_sessions;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        for (std::multimap<std::string, struct IdleSession>::iterator iter=_idle_sessions.begin(); iter!=_idle_sessions.end();)
+        {
+            if (iter->second.idle_time + static_cast<time_t>(_idle_seconds) < now)
+            {
+                expired_sessions.push_back(iter->second.libssh2);
+                _idle_sessions.erase(iter++);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    for (std::vector<CLibssh2*>::size_type i=0; i<expired_sessions.size(); ++i)
+        delete expired_sessions[i];
+}
+
+size_t CLibssh2Pool::get_idle_number() const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    return _idle_sessions.size();
+}
+
+std::string CLibssh2Pool::get_key(const std::string& ip, uint16_t port, const std::string& username)
+{
+    return utils::CStringUtils::format_string("%s:%d:%s", ip.c_str(), static_cast<int>(port), username.c_str());
+}
+
 #endif // MOOON_HAVE_LIBSSH2
 NET_NAMESPACE_END
@@ -17,6 +17,10 @@
  * Author: jian yi, eyjian@qq.com
  */
 #include <fcntl.h>
+#include <linux/filter.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/utils.h>
 #include "net/utils.h"
 #include "net/listener.h"
@@ -24,6 +28,7 @@ NET_NAMESPACE_BEGIN
 
 CListener::CListener()
     :_port(0)
+    ,_backlog(10000)
 {
 }
 
@@ -106,7 +111,7 @@ void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, boo
         }
 
         // 如果没有bind，则会随机选一个IP和端口，所以listen之前必须有bind
-        retval = ::listen(fd, 10000);
+        retval = ::listen(fd, _backlog);
         if (-1 == retval)
             THROW_SYSCALL_EXCEPTION(NULL, errno, "listen");
 
@@ -129,29 +134,80 @@ void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, boo
 void CListener::listen(const ipv4_node_t& ip_node, bool nonblock, bool enabled_address_zero, bool reuse_port)
 {
     ip_address_t ip = ip_node.ip;
-    listen(ip, ip_node.port, nonblock, enabled_address_zero);
+    listen(ip, ip_node.port, nonblock, enabled_address_zero, reuse_port);
 }
 
 void CListener::listen(const ipv6_node_t& ip_node, bool nonblock, bool enabled_address_zero, bool reuse_port)
 {
     ip_address_t ip = (uint32_t*)ip_node.ip;
-    listen(ip, ip_node.port, nonblock, enabled_address_zero);
+    listen(ip, ip_node.port, nonblock, enabled_address_zero, reuse_port);
 }
 
-int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port)
+void CListener::set_incoming_cpu(int cpu)
+{
+#if defined(SO_INCOMING_CPU)
+    if (-1 == ::setsockopt(CEpollable::get_fd(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "setsockopt");
+#endif // SO_INCOMING_CPU
+}
+
+void CListener::enable_fast_open(int queue_length)
+{
+#if defined(TCP_FASTOPEN)
+    if (-1 == ::setsockopt(CEpollable::get_fd(), IPPROTO_TCP, TCP_FASTOPEN, &queue_length, sizeof(queue_length)))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "setsockopt");
+#endif // TCP_FASTOPEN
+}
+
+void CListener::attach_reuseport_cpu_steering(uint16_t group_size)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+    if (0 == group_size)
+        THROW_EXCEPTION("group size is zero", EINVAL);
+
+    // 返回值为组内监听者的序号：A = cpu % group_size
+    struct sock_filter code[] =
+    {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+        { BPF_RET | BPF_A, 0, 0, 0 }
+    };
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (-1 == ::setsockopt(CEpollable::get_fd(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "setsockopt");
+#endif // SO_ATTACH_REUSEPORT_CBPF
+}
+
+void CListener::set_defer_accept(uint32_t seconds)
+{
+#if defined(TCP_DEFER_ACCEPT)
+    int value = static_cast<int>(seconds);
+    if (-1 == ::setsockopt(CEpollable::get_fd(), IPPROTO_TCP, TCP_DEFER_ACCEPT, &value, sizeof(value)))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "setsockopt");
+#endif // TCP_DEFER_ACCEPT
+}
+
+// 以accept4接受一个连接，同时设置FD_CLOEXEC和（可选的）非阻塞，省去之后的fcntl
+static int accept_one(int listen_fd, bool nonblock, ip_address_t& peer_ip, uint16_t& peer_port)
 {
     struct sockaddr_in6 peer_addr_in6;
     struct sockaddr* peer_addr = (struct sockaddr*)&peer_addr_in6;        
     socklen_t peer_addrlen = sizeof(struct sockaddr_in6); // 使用最大的
 
-    int newfd = ::accept(CEpollable::get_fd(), peer_addr, &peer_addrlen);
+    int newfd = ::accept4(listen_fd, peer_addr, &peer_addrlen, SOCK_CLOEXEC | (nonblock? SOCK_NONBLOCK: 0));
     if (-1 == newfd) 
-    {
-        if (sys::Error::code() != EWOULDBLOCK)
-            THROW_SYSCALL_EXCEPTION(NULL, errno, "accept");
-        
-        return -1;      
-    }
+        return -1;
 
     // 接受的是一个IPV4请求
     if (AF_INET == peer_addr->sa_family)
@@ -170,4 +226,113 @@ int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port)
     return newfd;
 }
 
+int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port)
+{
+    int newfd = accept_one(CEpollable::get_fd(), false, peer_ip, peer_port);
+    if (-1 == newfd) 
+    {
+        if (sys::Error::code() != EWOULDBLOCK)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "accept");
+        
+        return -1;      
+    }
+
+    return newfd;
+}
+
+int CListener::accept_batch(accepted_t* accepted_array, int max_number, bool nonblock)
+{
+    int number = 0;
+    while (number < max_number)
+    {
+        accepted_t& accepted = accepted_array[number];
+        accepted.fd = accept_one(CEpollable::get_fd(), nonblock, accepted.peer_ip, accepted.peer_port);
+        if (accepted.fd != -1)
+        {
+            ++number;
+            continue;
+        }
+
+        // 连接在accept前已被对端重置，或被信号中断，继续取下一个
+        const int errcode = sys::Error::code();
+        if ((ECONNABORTED == errcode) || (EINTR == errcode))
+            continue;
+        if (EWOULDBLOCK == errcode)
+            break;
+
+        // 如EMFILE，已接受的先返回，错误留给下一次调用
+        if (number > 0)
+            break;
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "accept4");
+    }
+
+    return number;
+}
+
+bool CListener::get_queue_info(uint32_t* queue_length, uint32_t* max_length) const
+{
+    // 对于监听者，tcpi_unacked为已完成握手未被accept的连接数，tcpi_sacked为backlog
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+    if (-1 == ::getsockopt(CEpollable::get_fd(), IPPROTO_TCP, TCP_INFO, &info, &info_length))
+        return false;
+
+    *queue_length = info.tcpi_unacked;
+    *max_length = info.tcpi_sacked;
+    return true;
+}
+
+bool CListener::get_listen_stats(listen_stats_t* stats)
+{
+    memset(stats, 0, sizeof(listen_stats_t));
+    stats->syncookies = -1;
+
+    FILE* fp = fopen("/proc/sys/net/ipv4/tcp_syncookies", "r");
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%d", &stats->syncookies) != 1)
+            stats->syncookies = -1;
+        fclose(fp);
+    }
+
+    // TcpExt占两行，第一行为名字，第二行为对应的值
+    fp = fopen("/proc/net/netstat", "r");
+    if (NULL == fp)
+        return false;
+
+    bool found = false;
+    char names[8192];
+    char values[8192];
+    while (fgets(names, sizeof(names), fp) != NULL)
+    {
+        if ((strncmp(names, "TcpExt:", 7) != 0) || (NULL == fgets(values, sizeof(values), fp)))
+            continue;
+
+        char* name_saveptr = NULL;
+        char* value_saveptr = NULL;
+        char* name = strtok_r(names, " \n", &name_saveptr);
+        char* value = strtok_r(values, " \n", &value_saveptr);
+        for (; (name != NULL) && (value != NULL); name=strtok_r(NULL, " \n", &name_saveptr), value=strtok_r(NULL, " \n", &value_saveptr))
+        {
+            const uint64_t number = strtoull(value, NULL, 10);
+            if (0 == strcmp(name, "ListenOverflows"))
+                stats->listen_overflows = number;
+            else if (0 == strcmp(name, "ListenDrops"))
+                stats->listen_drops = number;
+            else if (0 == strcmp(name, "SyncookiesSent"))
+                stats->syncookies_sent = number;
+            else if (0 == strcmp(name, "SyncookiesRecv"))
+                stats->syncookies_recv = number;
+            else if (0 == strcmp(name, "SyncookiesFailed"))
+                stats->syncookies_failed = number;
+        }
+
+        found = true;
+        break;
+    }
+
+    fclose(fp);
+    return found;
+}
+
 NET_NAMESPACE_END
@@ -0,0 +1,88 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/log_sink.h"
+#include "sys/logger.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include <arpa/inet.h>
+#include <string.h>
+NET_NAMESPACE_BEGIN
+
+CUdpLogSink::CUdpLogSink(const std::string& ip, uint16_t port, uint32_t message_size)
+    : _arena(sys::LOG_NUMBER_SENT_ONCE, message_size)
+{
+    memset(&_to_addr, 0, sizeof(_to_addr));
+    _to_addr.sin_family = AF_INET;
+    _to_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &_to_addr.sin_addr) != 1)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("invalid ip of udp log sink: %s", ip.c_str()), EINVAL);
+
+    _packet.reserve(message_size);
+    _last_lines.reserve(sys::LOG_NUMBER_SENT_ONCE);
+}
+
+int CUdpLogSink::send(const struct iovec* log_lines, int number)
+{
+    const size_t message_size = _arena.get_message_size();
+    _arena.clear();
+    _packet.clear();
+    _last_lines.clear();
+
+    // 按行拼成数据报，一行只在一个数据报中，一行放不下时截断
+    for (int i=0; i<number; ++i)
+    {
+        const char* line = static_cast<const char*>(log_lines[i].iov_base);
+        size_t line_size = log_lines[i].iov_len;
+        if (line_size > message_size)
+            line_size = message_size;
+        if (_packet.size() + line_size > message_size)
+        {
+            (void)_arena.add(_packet.data(), _packet.size(), _to_addr);
+            _last_lines.push_back(i - 1);
+            _packet.clear();
+        }
+
+        _packet.append(line, line_size);
+    }
+    if (!_packet.empty())
+    {
+        (void)_arena.add(_packet.data(), _packet.size(), _to_addr);
+        _last_lines.push_back(number - 1);
+    }
+
+    uint32_t offset = 0;
+    try
+    {
+        while (offset < _arena.get_number())
+        {
+            const int sent = _socket.send_batch(&_arena, offset);
+            if (sent <= 0)
+                break;
+            offset += static_cast<uint32_t>(sent);
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        // 出错（如网络不可达）的数据报和之后的由调用者写本地文件
+    }
+
+    return (0 == offset)? 0: _last_lines[offset-1] + 1;
+}
+
+NET_NAMESPACE_END
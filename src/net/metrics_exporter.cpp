@@ -0,0 +1,390 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/metrics_exporter.h"
+#include "sys/clock.h"
+#include "sys/log.h"
+#include "sys/metrics.h"
+#include "utils/string_utils.h"
+
+// 以HTTP提供度量的监听IP和端口（端口为0时表示不提供）
+STRING_ARG_DEFINE(metrics_ip, "127.0.0.1", "IP to serve metrics over HTTP");
+INTEGER_ARG_DEFINE(uint16_t, metrics_port, 0, 0, 65535, "port to serve metrics over HTTP, will not serve if 0");
+
+// UDP推送度量的目标（值为空时表示不推送）
+STRING_ARG_DEFINE(metrics_push, "", "IP:port to push metrics over UDP, will not push if empty");
+INTEGER_ARG_DEFINE(int, metrics_push_interval, 10, 1, 3600, "interval to push metrics in seconds");
+
+// 采样本机和当前进程资源使用率的间隔毫秒数（为0时表示不采样）
+INTEGER_ARG_DEFINE(int, metrics_sample_interval, 1000, 0, 3600000, "interval to sample cpu, context switches and network rates in milliseconds, will not sample if 0");
+
+NET_NAMESPACE_BEGIN
+
+// 请求最大字节数，超过时关闭连接
+#define METRICS_REQUEST_MAX 8192
+
+// 最多同时的连接数，超过时新连接被立即关闭
+#define METRICS_CONNECTION_MAX 64
+
+// 连接在这么多毫秒内未完成请求和应答时被关闭
+#define METRICS_IDLE_MILLISECONDS 10000
+
+// 每个UDP数据报的最大字节数
+#define METRICS_DATAGRAM_SIZE 1400
+
+// 一个HTTP连接，收完请求头后应答，应答写完后关闭
+class CMetricsConnection: public CEpollable
+{
+public:
+    CMetricsConnection(int fd)
+        : _start_milliseconds(sys::CClock::get_milliseconds()), _offset(0)
+    {
+        set_fd(fd);
+    }
+
+    uint64_t get_start_milliseconds() const { return _start_milliseconds; }
+
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+    {
+        CMetricsExporter* exporter = static_cast<CMetricsExporter*>(input_ptr);
+
+        if (_response.empty())
+        {
+            char buffer[2048];
+            const ssize_t bytes = ::recv(get_fd(), buffer, sizeof(buffer), 0);
+            if (-1 == bytes)
+                return ((EAGAIN == errno) || (EINTR == errno))? epoll_none: epoll_close;
+            if (0 == bytes)
+                return epoll_close;
+
+            _request.append(buffer, bytes);
+            if (_request.size() > METRICS_REQUEST_MAX)
+                return epoll_close;
+            if (std::string::npos == _request.find("\r\n\r\n"))
+                return epoll_none;
+
+            // 请求行：GET /metrics HTTP/1.1
+            std::string path;
+            if (0 == _request.compare(0, 4, "GET "))
+            {
+                const std::string::size_type end = _request.find_first_of(" ?\r", 4);
+                if (end != std::string::npos)
+                    path = _request.substr(4, end-4);
+            }
+            _response = exporter->get_response(path);
+        }
+
+        while (_offset < _response.size())
+        {
+            const ssize_t bytes = ::send(get_fd(), _response.data()+_offset, _response.size()-_offset, MSG_NOSIGNAL);
+            if (-1 == bytes)
+            {
+                if (EINTR == errno)
+                    continue;
+                return (EAGAIN == errno)? epoll_write: epoll_close;
+            }
+
+            _offset += static_cast<size_t>(bytes);
+        }
+
+        return epoll_close;
+    }
+
+private:
+    const uint64_t _start_milliseconds;
+    std::string _request;
+    std::string _response;
+    size_t _offset;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+CMetricsExporter::CMetricsExporter()
+    : _http_enabled(false), _http_port(0), _push_enabled(false), _push_port(0), _push_interval_seconds(0),
+      _sample_interval_milliseconds(0), _udp_socket(NULL), _engine(NULL), _stop(false),
+      _request_number(0), _push_number(0), _sample_number(0)
+{
+}
+
+CMetricsExporter::~CMetricsExporter()
+{
+    stop();
+}
+
+void CMetricsExporter::enable_http(const std::string& ip, uint16_t port)
+{
+    _http_enabled = true;
+    _http_ip = ip;
+    _http_port = port;
+}
+
+void CMetricsExporter::enable_push(const std::string& ip, uint16_t port, uint32_t interval_seconds)
+{
+    _push_enabled = true;
+    _push_ip = ip;
+    _push_port = port;
+    _push_interval_seconds = (0 == interval_seconds)? 1: interval_seconds;
+}
+
+void CMetricsExporter::enable_sampling(uint32_t interval_milliseconds)
+{
+    _sample_interval_milliseconds = interval_milliseconds;
+}
+
+void CMetricsExporter::start()
+{
+    _stop = false;
+    _epoller.create(METRICS_CONNECTION_MAX + 1);
+
+    try
+    {
+        if (_http_enabled)
+        {
+            _listener.listen(ip_address_t(_http_ip.c_str()), _http_port, true, true);
+
+            struct sockaddr_storage addr;
+            socklen_t addr_len = sizeof(addr);
+            if (-1 == getsockname(_listener.get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "getsockname");
+            if (AF_INET6 == addr.ss_family)
+                _http_port = ntohs(reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port);
+            else
+                _http_port = ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+            _epoller.set_events(&_listener, EPOLLIN);
+        }
+        if (_push_enabled)
+        {
+            _udp_socket = new CUdpSocket;
+        }
+
+        _engine = new sys::CThreadEngine(sys::bind(&CMetricsExporter::run, this));
+    }
+    catch (...)
+    {
+        stop();
+        throw;
+    }
+}
+
+void CMetricsExporter::stop()
+{
+    _stop = true;
+    if (_engine != NULL)
+    {
+        _epoller.wakeup();
+        delete _engine; // 析构时等待线程退出
+        _engine = NULL;
+    }
+
+    // 关闭句柄时自动从epoll中剔除
+    for (std::set<CMetricsConnection*>::iterator iter=_connections.begin(); iter!=_connections.end(); ++iter)
+        delete *iter;
+    _connections.clear();
+    _listener.close();
+
+    delete _udp_socket;
+    _udp_socket = NULL;
+    _epoller.destroy();
+}
+
+void CMetricsExporter::run()
+{
+    uint64_t push_milliseconds = sys::CClock::get_milliseconds() + _push_interval_seconds * 1000;
+    uint64_t sample_milliseconds = 0;
+
+    while (!_stop)
+    {
+        try
+        {
+            uint32_t milliseconds = 1000;
+            if (_sample_interval_milliseconds > 0)
+            {
+                // 先于推送采样，使同一轮推送的是最新的速率
+                const uint64_t now = sys::CClock::get_milliseconds();
+                if (now >= sample_milliseconds)
+                {
+                    sample();
+                    sample_milliseconds = now + _sample_interval_milliseconds;
+                }
+                if (sample_milliseconds - now < milliseconds)
+                    milliseconds = static_cast<uint32_t>(sample_milliseconds - now);
+            }
+            if (_push_enabled)
+            {
+                const uint64_t now = sys::CClock::get_milliseconds();
+                if (now >= push_milliseconds)
+                {
+                    push();
+                    push_milliseconds = now + _push_interval_seconds * 1000;
+                }
+                if (push_milliseconds - now < milliseconds)
+                    milliseconds = static_cast<uint32_t>(push_milliseconds - now);
+            }
+
+            const int n = _epoller.timed_wait(milliseconds);
+            for (int i=0; i<n; ++i)
+            {
+                CEpollable* epollable = _epoller.get(i);
+                if (epollable == &_listener)
+                {
+                    accept_connections();
+                }
+                else
+                {
+                    CMetricsConnection* connection = static_cast<CMetricsConnection*>(epollable);
+                    const epoll_event_t result = connection->handle_epoll_event(this, _epoller.get_events(i), NULL);
+                    if (epoll_write == result)
+                        _epoller.set_events(connection, EPOLLOUT);
+                    else if (epoll_close == result)
+                        close_connection(connection);
+                }
+            }
+
+            close_idle_connections();
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            MYLOG_ERROR("metrics exporter error: %s\n", ex.str().c_str());
+        }
+    }
+}
+
+void CMetricsExporter::accept_connections()
+{
+    accepted_t accepted_array[16];
+    for (;;)
+    {
+        const int number = _listener.accept_batch(accepted_array, sizeof(accepted_array)/sizeof(accepted_array[0]));
+        if (0 == number)
+            break;
+
+        for (int i=0; i<number; ++i)
+        {
+            const int fd = accepted_array[i].fd;
+            if (_connections.size() >= METRICS_CONNECTION_MAX)
+            {
+                ::close(fd);
+                continue;
+            }
+
+            CMetricsConnection* connection = new CMetricsConnection(fd);
+            try
+            {
+                _epoller.set_events(connection, EPOLLIN);
+                _connections.insert(connection);
+            }
+            catch (sys::CSyscallException&)
+            {
+                delete connection;
+                for (int j=i+1; j<number; ++j)
+                    ::close(accepted_array[j].fd);
+                throw;
+            }
+        }
+    }
+}
+
+void CMetricsExporter::close_connection(CMetricsConnection* connection)
+{
+    _epoller.del_events(connection);
+    _connections.erase(connection);
+    delete connection;
+}
+
+void CMetricsExporter::close_idle_connections()
+{
+    const uint64_t now = sys::CClock::get_milliseconds();
+    for (std::set<CMetricsConnection*>::iterator iter=_connections.begin(); iter!=_connections.end();)
+    {
+        CMetricsConnection* connection = *iter++;
+        if (now - connection->get_start_milliseconds() > METRICS_IDLE_MILLISECONDS)
+            close_connection(connection);
+    }
+}
+
+void CMetricsExporter::push()
+{
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    const std::string text = sys::CMetricsRegistry::to_prometheus(snapshot);
+
+    // 按行打包，不把一行拆到两个数据报中
+    std::string::size_type begin = 0;
+    while (begin < text.size())
+    {
+        std::string::size_type end = begin;
+        while (end < text.size())
+        {
+            std::string::size_type line_end = text.find('\n', end);
+            line_end = (std::string::npos == line_end)? text.size(): line_end+1;
+            if ((line_end - begin > METRICS_DATAGRAM_SIZE) && (end > begin))
+                break;
+            end = line_end;
+        }
+
+        (void)_udp_socket->send_to(text.data()+begin, end-begin, _push_ip.c_str(), _push_port);
+        begin = end;
+    }
+
+    __atomic_add_fetch(&_push_number, 1, __ATOMIC_RELAXED);
+}
+
+void CMetricsExporter::sample()
+{
+    sys::CInfoSampler::resource_rates_t rates;
+    if (_sampler.sample(&rates))
+    {
+        sys::CInfoSampler::publish_metrics(rates);
+        __atomic_add_fetch(&_sample_number, 1, __ATOMIC_RELAXED);
+    }
+}
+
+std::string CMetricsExporter::get_response(const std::string& path)
+{
+    std::string status = "200 OK";
+    std::string content_type;
+    std::string body;
+
+    if (("/metrics" == path) || ("/metrics.json" == path))
+    {
+        sys::MetricsSnapshot snapshot;
+        sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+        if ("/metrics" == path)
+        {
+            content_type = "text/plain; version=0.0.4";
+            body = sys::CMetricsRegistry::to_prometheus(snapshot);
+        }
+        else
+        {
+            content_type = "application/json";
+            body = sys::CMetricsRegistry::to_json(snapshot);
+        }
+    }
+    else
+    {
+        status = "404 Not Found";
+        content_type = "text/plain";
+        body = "not found\n";
+    }
+
+    __atomic_add_fetch(&_request_number, 1, __ATOMIC_RELAXED);
+    return utils::CStringUtils::format_string(
+        "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        status.c_str(), content_type.c_str(), body.size()) + body;
+}
+
+NET_NAMESPACE_END
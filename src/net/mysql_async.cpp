@@ -0,0 +1,520 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/mysql_async.h"
+#include "sys/clock.h"
+#include "sys/log.h"
+#include "sys/metrics.h"
+
+#if MOOON_HAVE_MYSQL==1
+#include <mysql/errmsg.h> // CR_CONNECTION_ERROR
+#include <mysql/mysql.h>
+
+// 非阻塞接口只有MariaDB Connector/C提供，MYSQL_WAIT_READ等由它的mysql.h定义
+#ifdef MYSQL_WAIT_READ
+NET_NAMESPACE_BEGIN
+
+static sys::CLatencyHistogram* get_latency_histogram()
+{
+    static sys::CLatencyHistogram* histogram = sys::CMetricsRegistry::get_singleton()->get_histogram("mysql_async.latency_ns");
+    return histogram;
+}
+
+static sys::CCounter* get_error_counter()
+{
+    static sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("mysql_async.errors");
+    return counter;
+}
+
+// 投递到循环线程中的查询
+class CAsyncMySQLConnection::CQueryTask: public ILoopTask
+{
+public:
+    CQueryTask(CAsyncMySQLConnection* connection, const Query& query)
+        : _connection(connection), _query(query)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _connection->enqueue(_query);
+    }
+
+private:
+    CAsyncMySQLConnection* _connection;
+    Query _query;
+};
+
+class CAsyncMySQLConnection::CReleaseTask: public ILoopTask
+{
+public:
+    CReleaseTask(CAsyncMySQLConnection* connection)
+        : _connection(connection)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _connection->do_release();
+    }
+
+private:
+    CAsyncMySQLConnection* _connection;
+};
+
+CAsyncMySQLConnection::CAsyncMySQLConnection(CEventLoop* event_loop, const mysql_config_t& config)
+    : _event_loop(event_loop), _config(config), _mysql_handle(NULL), _state(state_closed),
+      _registered(false), _released(false), _timer_id(0),
+      _connect_result(NULL), _query_result(0), _store_result(NULL), _pending_number(0)
+{
+    inc_refcount(); // 创建者的引用，由release减去
+}
+
+CAsyncMySQLConnection::~CAsyncMySQLConnection()
+{
+    if (_mysql_handle != NULL)
+    {
+        detach(); // fd由mysql_close关闭
+        mysql_close(static_cast<MYSQL*>(_mysql_handle));
+    }
+}
+
+void CAsyncMySQLConnection::query(const std::string& sql, IMySQLResultHandler* handler)
+{
+    Query query;
+    query.sql = sql;
+    query.handler = handler;
+    query.start_time = sys::CClock::get_nanoseconds();
+    __atomic_add_fetch(&_pending_number, 1, __ATOMIC_RELAXED);
+
+    if (_event_loop->in_loop_thread())
+        enqueue(query);
+    else
+        _event_loop->post(new CQueryTask(this, query));
+}
+
+void CAsyncMySQLConnection::release()
+{
+    // 在循环线程中也投递，回调中调用release时，对象在回调返回后才被删除
+    _event_loop->post(new CReleaseTask(this));
+}
+
+epoll_event_t CAsyncMySQLConnection::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    int status = 0;
+    if (events & EPOLLIN)
+        status |= MYSQL_WAIT_READ;
+    if (events & EPOLLOUT)
+        status |= MYSQL_WAIT_WRITE;
+    if (events & (EPOLLERR|EPOLLHUP))
+        status |= MYSQL_WAIT_EXCEPT;
+
+    if ((state_idle == _state) || (state_closed == _state))
+    {
+        // 没有查询时可读，只能是服务端关闭了连接（如wait_timeout），下次查询时重连
+        MYLOG_INFO("mysql://%s@%s:%d closed by server\n", _config.db_name.c_str(), _config.db_ip.c_str(), _config.db_port);
+        disconnect();
+    }
+    else
+    {
+        resume(status);
+    }
+
+    return epoll_none;
+}
+
+uint32_t CAsyncMySQLConnection::on_timer(CEventLoop* event_loop, uint64_t timer_id)
+{
+    if (timer_id == _timer_id)
+    {
+        _timer_id = 0;
+        resume(MYSQL_WAIT_TIMEOUT);
+    }
+    return 0;
+}
+
+void CAsyncMySQLConnection::enqueue(const Query& query)
+{
+    if (_released)
+    {
+        _queries.push_back(query);
+        fail_all(CR_CONNECTION_ERROR, "connection released");
+        return;
+    }
+
+    _queries.push_back(query);
+    if (state_closed == _state)
+        start_connect();
+    else if (state_idle == _state)
+        start_query();
+}
+
+void CAsyncMySQLConnection::do_release()
+{
+    _released = true;
+    fail_all(CR_CONNECTION_ERROR, "connection released");
+    disconnect();
+    dec_refcount();
+}
+
+void CAsyncMySQLConnection::start_connect()
+{
+    MYSQL* mysql_handle = mysql_init(NULL);
+    if (NULL == mysql_handle)
+    {
+        fail_all(CR_OUT_OF_MEMORY, "mysql_init failed");
+        return;
+    }
+
+    const unsigned int connect_timeout = static_cast<unsigned int>(_config.connect_timeout_seconds);
+    const unsigned int read_timeout = static_cast<unsigned int>(_config.read_timeout_seconds);
+    const unsigned int write_timeout = static_cast<unsigned int>(_config.write_timeout_seconds);
+    _mysql_handle = mysql_handle;
+    mysql_options(mysql_handle, MYSQL_OPT_NONBLOCK, 0);
+    mysql_options(mysql_handle, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+    mysql_options(mysql_handle, MYSQL_OPT_READ_TIMEOUT, &read_timeout);
+    mysql_options(mysql_handle, MYSQL_OPT_WRITE_TIMEOUT, &write_timeout);
+    if (!_config.charset.empty())
+        mysql_options(mysql_handle, MYSQL_SET_CHARSET_NAME, _config.charset.c_str());
+
+    MYSQL* connect_result = NULL;
+    _state = state_connecting;
+    const int status = mysql_real_connect_start(&connect_result, mysql_handle,
+            _config.db_ip.c_str(), _config.db_user.c_str(), _config.db_password.c_str(),
+            _config.db_name.empty()? NULL: _config.db_name.c_str(), _config.db_port, NULL, 0);
+    if (status != 0)
+        wait_for(status);
+    else
+        finish_connect(connect_result != NULL);
+}
+
+void CAsyncMySQLConnection::start_query()
+{
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+    const Query& query = _queries.front();
+
+    _state = state_querying;
+    const int status = mysql_real_query_start(&_query_result, mysql_handle, query.sql.data(), static_cast<unsigned long>(query.sql.size()));
+    if (status != 0)
+    {
+        wait_for(status);
+    }
+    else
+    {
+        // 在start中直接完成，走和cont相同的路径
+        resume(0);
+    }
+}
+
+void CAsyncMySQLConnection::resume(int status)
+{
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+
+    if (_timer_id != 0)
+    {
+        (void)_event_loop->cancel_timer(_timer_id);
+        _timer_id = 0;
+    }
+
+    if (state_connecting == _state)
+    {
+        MYSQL* connect_result = NULL;
+        status = mysql_real_connect_cont(&connect_result, mysql_handle, status);
+        if (status != 0)
+            wait_for(status);
+        else
+            finish_connect(connect_result != NULL);
+    }
+    else if (state_querying == _state)
+    {
+        if (status != 0)
+        {
+            status = mysql_real_query_cont(&_query_result, mysql_handle, status);
+            if (status != 0)
+            {
+                wait_for(status);
+                return;
+            }
+        }
+        if (_query_result != 0)
+        {
+            fail_query(mysql_errno(mysql_handle), mysql_error(mysql_handle));
+            return;
+        }
+
+        MYSQL_RES* store_result = NULL;
+        _state = state_storing;
+        status = mysql_store_result_start(&store_result, mysql_handle);
+        if (status != 0)
+            wait_for(status);
+        else
+            finish_query(store_result);
+    }
+    else if (state_storing == _state)
+    {
+        MYSQL_RES* store_result = NULL;
+        status = mysql_store_result_cont(&store_result, mysql_handle, status);
+        if (status != 0)
+            wait_for(status);
+        else
+            finish_query(store_result);
+    }
+}
+
+void CAsyncMySQLConnection::wait_for(int status)
+{
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+    int events = 0;
+    if (status & MYSQL_WAIT_READ)
+        events |= EPOLLIN;
+    if (status & MYSQL_WAIT_WRITE)
+        events |= EPOLLOUT;
+
+    if (!_registered)
+    {
+        set_fd(mysql_get_socket(mysql_handle));
+        _event_loop->add(this, events);
+        _registered = true;
+    }
+    else
+    {
+        _event_loop->modify(this, events);
+    }
+
+    if (status & MYSQL_WAIT_TIMEOUT)
+        _timer_id = _event_loop->run_after(mysql_get_timeout_value_ms(mysql_handle), this);
+}
+
+void CAsyncMySQLConnection::finish_connect(bool success)
+{
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+
+    if (!success)
+    {
+        const std::string errmsg = mysql_error(mysql_handle);
+        const int errcode = mysql_errno(mysql_handle);
+        MYLOG_ERROR("connect mysql://%s@%s:%d error: (%d)%s\n", _config.db_name.c_str(), _config.db_ip.c_str(), _config.db_port, errcode, errmsg.c_str());
+        disconnect();
+        fail_all(errcode, errmsg);
+        return;
+    }
+
+    // 连接期间可能已换成了新的fd，如重试了其它地址
+    if (_registered && (get_fd() != mysql_get_socket(mysql_handle)))
+    {
+        _event_loop->remove(this, false);
+        _registered = false;
+    }
+    if (!_registered)
+    {
+        set_fd(mysql_get_socket(mysql_handle));
+        _event_loop->add(this, EPOLLIN);
+        _registered = true;
+    }
+
+    _state = state_idle;
+    if (!_queries.empty())
+        start_query();
+    else
+        _event_loop->modify(this, EPOLLIN);
+}
+
+void CAsyncMySQLConnection::finish_query(void* result_set)
+{
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+    MYSQL_RES* store_result = static_cast<MYSQL_RES*>(result_set);
+    mysql_result_t result;
+
+    if (store_result != NULL)
+    {
+        // 已全部读到本地，mysql_fetch_row不再有IO
+        const unsigned int num_fields = mysql_num_fields(store_result);
+        result.is_select = true;
+        result.rows.reserve(static_cast<size_t>(mysql_num_rows(store_result)));
+        while (true)
+        {
+            MYSQL_ROW row = mysql_fetch_row(store_result);
+            if (NULL == row)
+                break;
+
+            unsigned long* lengths = mysql_fetch_lengths(store_result);
+            result.rows.push_back(sys::DBRow());
+            sys::DBRow& db_row = result.rows.back();
+            db_row.resize(num_fields);
+            for (unsigned int i=0; i<num_fields; ++i)
+            {
+                if (row[i] != NULL)
+                    db_row[i].assign(row[i], lengths[i]);
+            }
+        }
+        result.affected_rows = static_cast<uint64_t>(result.rows.size());
+        mysql_free_result(store_result);
+    }
+    else if (mysql_field_count(mysql_handle) != 0)
+    {
+        fail_query(mysql_errno(mysql_handle), mysql_error(mysql_handle));
+        return;
+    }
+    else
+    {
+        result.affected_rows = static_cast<uint64_t>(mysql_affected_rows(mysql_handle));
+        result.insert_id = static_cast<uint64_t>(mysql_insert_id(mysql_handle));
+    }
+
+    const Query query = _queries.front();
+    _queries.pop_front();
+    _state = state_idle;
+    __atomic_sub_fetch(&_pending_number, 1, __ATOMIC_RELAXED);
+
+    result.latency_nanoseconds = sys::CClock::get_nanoseconds() - query.start_time;
+    get_latency_histogram()->record(result.latency_nanoseconds);
+    if (query.handler != NULL)
+        query.handler->on_result(this, &result);
+
+    // 回调中可能已提交了新的查询
+    if (state_idle == _state)
+    {
+        if (!_queries.empty())
+            start_query();
+        else
+            _event_loop->modify(this, EPOLLIN);
+    }
+}
+
+void CAsyncMySQLConnection::fail_query(int errcode, const std::string& errmsg)
+{
+    const Query query = _queries.front();
+    mysql_result_t result;
+
+    _queries.pop_front();
+    __atomic_sub_fetch(&_pending_number, 1, __ATOMIC_RELAXED);
+    get_error_counter()->inc();
+    result.errcode = errcode;
+    result.errmsg = errmsg;
+    result.latency_nanoseconds = sys::CClock::get_nanoseconds() - query.start_time;
+
+    // 连接已断开的，之后的查询在重连后执行
+    if ((CR_SERVER_GONE_ERROR == errcode) || (CR_SERVER_LOST == errcode))
+        disconnect();
+    else
+        _state = state_idle;
+
+    if (query.handler != NULL)
+        query.handler->on_result(this, &result);
+
+    if (!_queries.empty() && !_released)
+    {
+        if (state_closed == _state)
+            start_connect();
+        else if (state_idle == _state)
+            start_query();
+    }
+    else if (state_idle == _state)
+    {
+        _event_loop->modify(this, EPOLLIN);
+    }
+}
+
+void CAsyncMySQLConnection::fail_all(int errcode, const std::string& errmsg)
+{
+    std::deque<Query> queries;
+    queries.swap(_queries);
+
+    for (std::deque<Query>::size_type i=0; i<queries.size(); ++i)
+    {
+        mysql_result_t result;
+        result.errcode = errcode;
+        result.errmsg = errmsg;
+        result.latency_nanoseconds = sys::CClock::get_nanoseconds() - queries[i].start_time;
+
+        __atomic_sub_fetch(&_pending_number, 1, __ATOMIC_RELAXED);
+        get_error_counter()->inc();
+        if (queries[i].handler != NULL)
+            queries[i].handler->on_result(this, &result);
+    }
+}
+
+void CAsyncMySQLConnection::disconnect()
+{
+    if (_timer_id != 0)
+    {
+        (void)_event_loop->cancel_timer(_timer_id);
+        _timer_id = 0;
+    }
+    if (_registered)
+    {
+        // 创建者的引用保证remove中的dec_refcount不会删除对象
+        _event_loop->remove(this, false);
+        _registered = false;
+    }
+    if (_mysql_handle != NULL)
+    {
+        detach();
+        mysql_close(static_cast<MYSQL*>(_mysql_handle));
+        _mysql_handle = NULL;
+    }
+    _state = state_closed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CAsyncMySQLPool::CAsyncMySQLPool(CReactorPool* reactor_pool, uint16_t connections_per_loop, const mysql_config_t& config)
+    : _next(0)
+{
+    for (uint16_t i=0; i<connections_per_loop; ++i)
+    {
+        for (uint16_t loop_index=0; loop_index<reactor_pool->get_loop_number(); ++loop_index)
+            _connections.push_back(new CAsyncMySQLConnection(reactor_pool->get_loop(loop_index), config));
+    }
+}
+
+CAsyncMySQLPool::~CAsyncMySQLPool()
+{
+    for (std::vector<CAsyncMySQLConnection*>::size_type i=0; i<_connections.size(); ++i)
+        _connections[i]->release();
+}
+
+void CAsyncMySQLPool::query(const std::string& sql, IMySQLResultHandler* handler)
+{
+    // 从轮转的起点开始找在途查询最少的，起点轮转使得都空闲时也能分散到各连接
+    const uint32_t number = static_cast<uint32_t>(_connections.size());
+    const uint32_t start = __atomic_fetch_add(&_next, 1, __ATOMIC_RELAXED);
+    CAsyncMySQLConnection* selected = _connections[start % number];
+
+    for (uint32_t i=1; (i<number) && (selected->get_pending_number() > 0); ++i)
+    {
+        CAsyncMySQLConnection* connection = _connections[(start + i) % number];
+        if (connection->get_pending_number() < selected->get_pending_number())
+            selected = connection;
+    }
+
+    selected->query(sql, handler);
+}
+
+uint32_t CAsyncMySQLPool::get_pending_number() const
+{
+    uint32_t pending_number = 0;
+    for (std::vector<CAsyncMySQLConnection*>::size_type i=0; i<_connections.size(); ++i)
+        pending_number += _connections[i]->get_pending_number();
+    return pending_number;
+}
+
+NET_NAMESPACE_END
+#endif // MYSQL_WAIT_READ
+#endif // MOOON_HAVE_MYSQL
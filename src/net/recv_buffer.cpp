@@ -0,0 +1,160 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/recv_buffer.h"
+#include "sys/metrics.h"
+#include <algorithm>
+#include <string.h>
+NET_NAMESPACE_BEGIN
+
+static sys::CGauge* get_bytes_gauge()
+{
+    static sys::CGauge* gauge = sys::CMetricsRegistry::get_singleton()->get_gauge("recv_buffer.bytes");
+    return gauge;
+}
+
+CRecvBuffer::CRecvBuffer(size_t min_size, sys::CSlabMemPool* pool)
+    : _pool(pool), _min_size((0 == min_size)? 1: min_size), _data(NULL), _capacity(0), _begin(0), _end(0)
+{
+}
+
+CRecvBuffer::~CRecvBuffer()
+{
+    clear();
+}
+
+ssize_t CRecvBuffer::read_fd(int fd, size_t space)
+{
+    char extra[RECV_BUFFER_EXTRA_SIZE];
+    struct iovec iov[2];
+    const int iovcnt = prepare_read(iov, extra, space);
+    const ssize_t bytes = ::readv(fd, &iov[2-iovcnt], iovcnt);
+    if (bytes > 0)
+        commit_read(static_cast<size_t>(bytes), extra);
+    return bytes;
+}
+
+void CRecvBuffer::append(const char* data, size_t size)
+{
+    if (_capacity - _end < size)
+    {
+        const size_t need_size = _end - _begin + size;
+        if (need_size <= _capacity)
+        {
+            // 未处理的数据移到开头
+            memmove(_data, _data+_begin, _end-_begin);
+            _end -= _begin;
+            _begin = 0;
+        }
+        else
+        {
+            reallocate(get_class_size(need_size));
+        }
+    }
+
+    memcpy(_data+_end, data, size);
+    _end += size;
+}
+
+void CRecvBuffer::drain(size_t size)
+{
+    if (size >= _end - _begin)
+    {
+        clear();
+    }
+    else
+    {
+        _begin += size;
+
+        // 处理完大消息后剩余的很少时缩小，使连接不长期占着大的缓冲区
+        const size_t class_size = get_class_size(_end - _begin);
+        if ((_end - _begin) * 4 <= _capacity && (class_size < _capacity))
+            reallocate(class_size);
+    }
+}
+
+void CRecvBuffer::clear()
+{
+    if (_data != NULL)
+    {
+        if ((NULL == _pool) || !_pool->reclaim(_data, _capacity))
+            delete []_data;
+
+        get_bytes_gauge()->add(-static_cast<int64_t>(_capacity));
+        _data = NULL;
+        _capacity = 0;
+    }
+
+    _begin = 0;
+    _end = 0;
+}
+
+// 先收到尾部的空闲空间，余下的收到落地区，尾部没有空闲空间时只用iov[1]
+int CRecvBuffer::prepare_read(struct iovec* iov, char* extra, size_t space) const
+{
+    const size_t tail_size = std::min(_capacity - _end, space);
+
+    iov[0].iov_base = _data + _end;
+    iov[0].iov_len = tail_size;
+    iov[1].iov_base = extra;
+    iov[1].iov_len = std::min(space - tail_size, static_cast<size_t>(RECV_BUFFER_EXTRA_SIZE));
+    return (tail_size > 0)? 2: 1;
+}
+
+void CRecvBuffer::commit_read(size_t bytes, const char* extra)
+{
+    const size_t tail_size = _capacity - _end;
+
+    if (bytes <= tail_size)
+    {
+        _end += bytes;
+    }
+    else
+    {
+        _end = _capacity;
+        append(extra, bytes - tail_size);
+    }
+}
+
+// 不小于size的最小级别，级别从min_size开始按2的幂增长
+size_t CRecvBuffer::get_class_size(size_t size) const
+{
+    size_t class_size = _min_size;
+    while (class_size < size)
+        class_size *= 2;
+    return class_size;
+}
+
+void CRecvBuffer::reallocate(size_t capacity)
+{
+    char* data = (_pool != NULL)? static_cast<char*>(_pool->allocate(capacity)): NULL;
+    if (NULL == data)
+        data = new char[capacity];
+
+    const size_t size = _end - _begin;
+    if (size > 0)
+        memcpy(data, _data+_begin, size);
+    clear();
+
+    get_bytes_gauge()->add(static_cast<int64_t>(capacity));
+    _data = data;
+    _capacity = capacity;
+    _end = size;
+}
+
+NET_NAMESPACE_END
@@ -0,0 +1,1058 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/redis_client.h"
+#include "sys/log.h"
+#include "utils/exception.h"
+#include <algorithm>
+#include <deque>
+#include <strings.h>
+NET_NAMESPACE_BEGIN
+
+// 检查连接和命令超时的间隔毫秒数，也是没有空闲连接时重新借用的间隔
+#define REDIS_TIMER_MILLISECONDS 10
+
+// 一次recv的最小空闲空间和接收缓冲区的初始大小
+#define REDIS_RECV_SIZE_MIN  4096
+#define REDIS_RECV_BUFFER    16384
+
+typedef enum
+{
+    request_user,   /** 调用者的命令 */
+    request_asking, /** ASK重定向前的ASKING，应答被丢弃 */
+    request_slots,  /** CLUSTER SLOTS */
+    request_hello   /** HELLO 3 */
+}request_kind_t;
+
+struct RedisRequest
+{
+    request_kind_t kind;
+    uint16_t slot;
+    bool has_key;
+    int redirections;
+    uint64_t deadline; /** 超时的单调时钟毫秒数 */
+    IRedisCallback* callback;
+    std::string payload;
+    bool limited;              /** 是否占用了并发限制，完成时须释放 */
+    sys::CLimitTicket ticket;
+};
+
+static RedisRequest* new_request(request_kind_t kind, const std::vector<std::string>& args, uint32_t timeout)
+{
+    RedisRequest* request = new RedisRequest;
+    request->kind = kind;
+    request->slot = 0;
+    request->has_key = false;
+    request->redirections = 0;
+    request->deadline = CEventLoop::get_monotonic_milliseconds() + timeout;
+    request->callback = NULL;
+    request->limited = false;
+    CRespParser::format_command(args, &request->payload);
+    return request;
+}
+
+// 一个节点的连接，fd来自从连接池借用的CTcpClient，归还前先置为-1，以免被析构关闭
+class CRedisConnection: public CEpollable
+{
+    friend class CRedisClient;
+
+public:
+    CRedisConnection(CRedisClient* redis_client, const ip_node_t& ip_node)
+        : _redis_client(redis_client), _ip_node(ip_node), _client(NULL),
+          _create_time(CEventLoop::get_monotonic_milliseconds()),
+          _input_begin(0), _input_end(0), _output_offset(0),
+          _write_waiting(false), _dirty(false), _failed(false)
+    {
+    }
+
+    bool try_connect();
+    void enqueue(RedisRequest* request);
+    bool flush();
+    CTcpClient* detach();
+
+private:
+    virtual epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+    void receive();
+    void process();
+
+private:
+    CRedisClient* _redis_client;
+    ip_node_t _ip_node;
+    CTcpClient* _client;    /** 借用的连接，为NULL表示还未借到 */
+    uint64_t _create_time;
+    std::deque<RedisRequest*> _inflight;  /** 已放入发送缓冲区、等待应答的命令 */
+    std::vector<RedisRequest*> _pending;  /** 借到连接之前提交的命令 */
+    std::string _input;
+    size_t _input_begin;  /** 未解析数据的开始位置 */
+    size_t _input_end;
+    std::string _output;
+    size_t _output_offset; /** 已发送的字节数 */
+    bool _write_waiting;   /** 是否在等待可写事件 */
+    bool _dirty;           /** 是否在CRedisClient的待发送列表中 */
+    bool _failed;
+    CRespParser _parser;
+};
+
+// 同步命令的等待者，超时放弃后由应答回调删除
+class CSyncCallback: public IRedisCallback
+{
+public:
+    CSyncCallback(): _done(false), _abandoned(false) {}
+
+    bool wait(redis_reply_t* reply, uint32_t milliseconds)
+    {
+        const uint64_t deadline = CEventLoop::get_monotonic_milliseconds() + milliseconds;
+        bool done;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            while (!_done)
+            {
+                const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+                if (now >= deadline)
+                    break;
+                (void)_event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+            }
+
+            done = _done;
+            if (done)
+                std::swap(*reply, _reply);
+            else
+                _abandoned = true;
+        }
+
+        if (done)
+            delete this;
+        return done;
+    }
+
+private:
+    virtual void on_reply(const redis_reply_t& reply)
+    {
+        bool abandoned;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            abandoned = _abandoned;
+            if (!abandoned)
+            {
+                _reply = reply;
+                _done = true;
+                _event.signal();
+            }
+        }
+
+        if (abandoned)
+            delete this;
+    }
+
+private:
+    sys::CLock _lock;
+    sys::CEvent _event;
+    bool _done;
+    bool _abandoned;
+    redis_reply_t _reply;
+};
+
+class CRedisStartTask: public ILoopTask
+{
+public:
+    CRedisStartTask(CRedisClient* redis_client)
+        : _redis_client(redis_client)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _redis_client->start();
+    }
+
+private:
+    CRedisClient* _redis_client;
+};
+
+class CRedisDrainTask: public ILoopTask
+{
+public:
+    CRedisDrainTask(CRedisClient* redis_client)
+        : _redis_client(redis_client)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _redis_client->drain_submissions();
+    }
+
+private:
+    CRedisClient* _redis_client;
+};
+
+class CRedisStopTask: public ILoopTask
+{
+public:
+    CRedisStopTask(CRedisClient* redis_client)
+        : _redis_client(redis_client)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _redis_client->stop();
+    }
+
+private:
+    CRedisClient* _redis_client;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+bool CRedisConnection::try_connect()
+{
+    CTcpClient* client = _redis_client->_client_pool->borrow(_ip_node);
+    if (NULL == client)
+        return false;
+
+    set_fd(client->get_fd());
+    try
+    {
+        _redis_client->_event_loop->add(this, EPOLLIN);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("add redis connection %s error: %s\n", client->to_string().c_str(), ex.str().c_str());
+        set_fd(-1);
+        _redis_client->_client_pool->pay_back(client, true);
+        return false;
+    }
+
+    _client = client;
+    if (_redis_client->_resp3)
+    {
+        std::vector<std::string> args(2);
+        args[0] = "HELLO";
+        args[1] = "3";
+        enqueue(new_request(request_hello, args, _redis_client->_timeout));
+    }
+    for (std::vector<RedisRequest*>::size_type i=0; i<_pending.size(); ++i)
+        enqueue(_pending[i]);
+    _pending.clear();
+    return true;
+}
+
+void CRedisConnection::enqueue(RedisRequest* request)
+{
+    if (NULL == _client)
+    {
+        _pending.push_back(request);
+    }
+    else
+    {
+        _output.append(request->payload);
+        _inflight.push_back(request);
+    }
+}
+
+bool CRedisConnection::flush()
+{
+    while (_output_offset < _output.size())
+    {
+        const ssize_t bytes = ::send(get_fd(), _output.data()+_output_offset, _output.size()-_output_offset, MSG_NOSIGNAL);
+        if (bytes > 0)
+        {
+            _output_offset += bytes;
+            ++_redis_client->_send_number;
+        }
+        else if (EINTR == errno)
+        {
+            continue;
+        }
+        else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            if (!_write_waiting)
+            {
+                _redis_client->_event_loop->modify(this, EPOLLIN|EPOLLOUT);
+                _write_waiting = true;
+            }
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    _output.clear();
+    _output_offset = 0;
+    if (_write_waiting)
+    {
+        _redis_client->_event_loop->modify(this, EPOLLIN);
+        _write_waiting = false;
+    }
+    return true;
+}
+
+CTcpClient* CRedisConnection::detach()
+{
+    CTcpClient* client = _client;
+    set_fd(-1);
+    _client = NULL;
+    return client;
+}
+
+epoll_event_t CRedisConnection::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    if (_failed)
+        return epoll_none;
+
+    if ((events & EPOLLOUT) && !flush())
+        _redis_client->fail_connection(this, "ERR send to redis failed");
+    else if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        receive();
+
+    _redis_client->flush_dirty();
+    return epoll_none;
+}
+
+void CRedisConnection::receive()
+{
+    for (;;)
+    {
+        if (_input.size() - _input_end < REDIS_RECV_SIZE_MIN)
+        {
+            if (_input_begin > 0)
+            {
+                memmove(&_input[0], &_input[_input_begin], _input_end - _input_begin);
+                _input_end -= _input_begin;
+                _input_begin = 0;
+            }
+            if (_input.size() - _input_end < REDIS_RECV_SIZE_MIN)
+                _input.resize(std::max(_input.size()*2, static_cast<size_t>(REDIS_RECV_BUFFER)));
+        }
+
+        const size_t space = _input.size() - _input_end;
+        const ssize_t bytes = ::recv(get_fd(), &_input[_input_end], space, 0);
+        if (bytes > 0)
+        {
+            _input_end += bytes;
+            process();
+            if (_failed || (static_cast<size_t>(bytes) < space))
+                break;
+        }
+        else if (0 == bytes)
+        {
+            _redis_client->fail_connection(this, "ERR connection closed by redis");
+            break;
+        }
+        else if (EINTR == errno)
+        {
+            continue;
+        }
+        else
+        {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                _redis_client->fail_connection(this, "ERR receive from redis failed");
+            break;
+        }
+    }
+}
+
+void CRedisConnection::process()
+{
+    redis_reply_t reply;
+
+    while (!_failed && (_input_begin < _input_end))
+    {
+        size_t consumed = 0;
+        const int result = _parser.parse(&_input[_input_begin], _input_end-_input_begin, &consumed, &reply);
+        _input_begin += consumed;
+        if (0 == result)
+            break;
+        if (result < 0)
+        {
+            _redis_client->fail_connection(this, "ERR redis protocol error");
+            break;
+        }
+
+        // 推送不对应任何命令
+        if (reply_push == reply.type)
+            continue;
+        if (_inflight.empty())
+        {
+            _redis_client->fail_connection(this, "ERR unexpected reply from redis");
+            break;
+        }
+
+        RedisRequest* request = _inflight.front();
+        _inflight.pop_front();
+        _redis_client->on_reply(this, request, reply);
+    }
+
+    if (_input_begin == _input_end)
+    {
+        _input_begin = 0;
+        _input_end = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CRedisClient::CRedisClient(CEventLoop* event_loop, CTcpClientPool* client_pool)
+    : _event_loop(event_loop), _client_pool(client_pool),
+      _cluster(false), _resp3(false), _timeout(5000), _limiter(NULL), _timer_id(0),
+      _drain_posted(false), _stopped(true), _stop_done(false), _slots_refreshing(false),
+      _command_number(0), _limit_rejected_number(0), _send_number(0), _moved_number(0), _ask_number(0), _slots_refresh_number(0)
+{
+}
+
+CRedisClient::~CRedisClient()
+{
+    destroy();
+}
+
+void CRedisClient::add_node(const ip_node_t& ip_node)
+{
+    _seeds.push_back(ip_node);
+}
+
+void CRedisClient::create()
+{
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        _stopped = false;
+        _stop_done = false;
+    }
+
+    _event_loop->post(new CRedisStartTask(this));
+}
+
+void CRedisClient::destroy()
+{
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_stopped)
+            return;
+        _stopped = true;
+    }
+
+    _event_loop->post(new CRedisStopTask(this));
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    while (!_stop_done)
+        _event.wait(_lock);
+}
+
+void CRedisClient::async_command(const std::vector<std::string>& args, IRedisCallback* callback)
+{
+    // 被拒绝时不格式化命令，也不进入队列，以最小的代价快速失败
+    sys::CLimitTicket ticket;
+    if ((_limiter != NULL) && !_limiter->try_acquire(&ticket))
+    {
+        __atomic_add_fetch(&_limit_rejected_number, 1, __ATOMIC_RELAXED);
+        if (callback != NULL)
+            callback->on_reply(redis_reply_t(reply_error, "ERR redis concurrency limit exceeded"));
+        return;
+    }
+
+    RedisRequest* request = new_request(request_user, args, _timeout);
+    std::string_view key;
+    bool stopped = false;
+    bool need_post = false;
+
+    request->callback = callback;
+    request->limited = (_limiter != NULL);
+    request->ticket = ticket;
+    request->has_key = get_command_key(args, &key);
+    if (request->has_key)
+        request->slot = get_key_slot(key);
+    __atomic_add_fetch(&_command_number, 1, __ATOMIC_RELAXED);
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        stopped = _stopped;
+        if (!stopped)
+        {
+            _submissions.push_back(request);
+            need_post = !_drain_posted;
+            _drain_posted = true;
+        }
+    }
+
+    // 同一批提交只投递一个任务
+    if (need_post)
+        _event_loop->post(new CRedisDrainTask(this));
+    if (stopped)
+        finish(request, redis_reply_t(reply_error, "ERR redis client is not running"));
+}
+
+bool CRedisClient::command(const std::vector<std::string>& args, redis_reply_t* reply, uint32_t milliseconds)
+{
+    CSyncCallback* callback = new CSyncCallback;
+    async_command(args, callback);
+    return callback->wait(reply, milliseconds);
+}
+
+// CRC16-CCITT（XMODEM），同Redis集群的键槽计算
+uint16_t CRedisClient::get_key_slot(std::string_view key)
+{
+    const std::string_view::size_type open = key.find('{');
+    if (open != std::string_view::npos)
+    {
+        const std::string_view::size_type close = key.find('}', open+1);
+        if ((close != std::string_view::npos) && (close > open+1))
+            key = key.substr(open+1, close-open-1);
+    }
+
+    uint16_t crc = 0;
+    for (std::string_view::size_type i=0; i<key.size(); ++i)
+    {
+        crc ^= static_cast<uint16_t>(static_cast<unsigned char>(key[i])) << 8;
+        for (int j=0; j<8; ++j)
+            crc = (crc & 0x8000)? static_cast<uint16_t>((crc << 1) ^ 0x1021): static_cast<uint16_t>(crc << 1);
+    }
+    return crc & (REDIS_SLOT_NUMBER - 1);
+}
+
+bool CRedisClient::get_command_key(const std::vector<std::string>& args, std::string_view* key)
+{
+    static const char* keyless_commands[] = { "AUTH", "CLIENT", "CLUSTER", "CONFIG", "ECHO", "HELLO", "INFO", "PING", "SCRIPT", "SELECT", NULL };
+    if (args.size() < 2)
+        return false;
+
+    const char* name = args[0].c_str();
+    for (int i=0; keyless_commands[i]!=NULL; ++i)
+    {
+        if (0 == strcasecmp(name, keyless_commands[i]))
+            return false;
+    }
+
+    if ((0 == strcasecmp(name, "EVAL")) || (0 == strcasecmp(name, "EVALSHA"))
+     || (0 == strcasecmp(name, "EVAL_RO")) || (0 == strcasecmp(name, "EVALSHA_RO")) || (0 == strcasecmp(name, "FCALL")))
+    {
+        if ((args.size() < 4) || (atoi(args[2].c_str()) <= 0))
+            return false;
+        *key = args[3];
+        return true;
+    }
+
+    *key = args[1];
+    return true;
+}
+
+uint32_t CRedisClient::on_timer(CEventLoop* event_loop, uint64_t timer_id)
+{
+    const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+    std::vector<std::pair<CRedisConnection*, const char*> > failures;
+
+    for (connection_table_t::iterator iter=_connection_table.begin(); iter!=_connection_table.end(); ++iter)
+    {
+        CRedisConnection* connection = iter->second;
+        if (NULL == connection->_client)
+        {
+            if (connection->try_connect())
+                mark_dirty(connection);
+            else if (now - connection->_create_time >= _timeout)
+                failures.push_back(std::make_pair(connection, "ERR connect to redis timeout"));
+        }
+        else if (!connection->_inflight.empty() && (connection->_inflight.front()->deadline <= now))
+        {
+            failures.push_back(std::make_pair(connection, "ERR redis command timeout"));
+        }
+    }
+
+    for (std::vector<std::pair<CRedisConnection*, const char*> >::size_type i=0; i<failures.size(); ++i)
+        fail_connection(failures[i].first, failures[i].second);
+    flush_dirty();
+    return REDIS_TIMER_MILLISECONDS;
+}
+
+void CRedisClient::start()
+{
+    _timer_id = _event_loop->run_after(REDIS_TIMER_MILLISECONDS, this);
+}
+
+void CRedisClient::stop()
+{
+    const redis_reply_t reply(reply_error, "ERR redis client destroyed");
+    std::vector<RedisRequest*> requests;
+
+    (void)_event_loop->cancel_timer(_timer_id);
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        requests.swap(_submissions);
+        _drain_posted = false;
+    }
+    requests.insert(requests.end(), _slots_waiting.begin(), _slots_waiting.end());
+    _slots_waiting.clear();
+    for (std::vector<RedisRequest*>::size_type i=0; i<requests.size(); ++i)
+        finish(requests[i], reply);
+
+    // 没有在途命令的连接正常归还，以便被复用
+    std::vector<CRedisConnection*> connections;
+    for (connection_table_t::iterator iter=_connection_table.begin(); iter!=_connection_table.end(); ++iter)
+        connections.push_back(iter->second);
+    for (std::vector<CRedisConnection*>::size_type i=0; i<connections.size(); ++i)
+    {
+        CRedisConnection* connection = connections[i];
+        if (connection->_inflight.empty() && connection->_pending.empty())
+        {
+            _connection_table.erase(connection->_ip_node);
+            release_connection(connection, false);
+        }
+        else
+        {
+            fail_connection(connection, "ERR redis client destroyed");
+        }
+    }
+    flush_dirty();
+    _slot_table.clear();
+    _slots_refreshing = false;
+
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _stop_done = true;
+    _event.broadcast();
+}
+
+void CRedisClient::drain_submissions()
+{
+    std::vector<RedisRequest*> requests;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        requests.swap(_submissions);
+        _drain_posted = false;
+    }
+
+    for (std::vector<RedisRequest*>::size_type i=0; i<requests.size(); ++i)
+        route(requests[i]);
+    flush_dirty();
+}
+
+void CRedisClient::route(RedisRequest* request)
+{
+    if (_stopped)
+    {
+        finish(request, redis_reply_t(reply_error, "ERR redis client destroyed"));
+    }
+    else if (!_cluster || !request->has_key)
+    {
+        send_to(_seeds[0], request);
+    }
+    else if (_slot_table.empty())
+    {
+        _slots_waiting.push_back(request);
+        refresh_slots(NULL);
+    }
+    else
+    {
+        // 槽未被覆盖时交给种子节点，由MOVED纠正
+        const ip_node_t& ip_node = _slot_table[request->slot];
+        send_to((0 == ip_node.port)? _seeds[0]: ip_node, request);
+    }
+}
+
+void CRedisClient::send_to(const ip_node_t& ip_node, RedisRequest* request)
+{
+    CRedisConnection* connection = get_connection(ip_node);
+    connection->enqueue(request);
+    mark_dirty(connection);
+}
+
+void CRedisClient::refresh_slots(const ip_node_t* ip_node)
+{
+    if (_slots_refreshing)
+        return;
+
+    std::vector<std::string> args(2);
+    args[0] = "CLUSTER";
+    args[1] = "SLOTS";
+    _slots_refreshing = true;
+    ++_slots_refresh_number;
+
+    // 轮流使用种子节点，以免一直向不可用的节点请求
+    RedisRequest* request = new_request(request_slots, args, _timeout);
+    send_to((ip_node != NULL)? *ip_node: _seeds[_slots_refresh_number % _seeds.size()], request);
+}
+
+void CRedisClient::update_slots(const redis_reply_t& reply, const ip_node_t& from)
+{
+    std::vector<ip_node_t> slot_table(REDIS_SLOT_NUMBER);
+
+    // 每个成员为[起始槽, 结束槽, [主节点IP, 端口, ID], 从节点...]
+    for (std::vector<redis_reply_t>::size_type i=0; i<reply.elements.size(); ++i)
+    {
+        const redis_reply_t& range = reply.elements[i];
+        if ((range.elements.size() < 3) || (range.elements[2].elements.size() < 2))
+            continue;
+
+        const int64_t start = range.elements[0].integer;
+        const int64_t end = range.elements[1].integer;
+        const redis_reply_t& master = range.elements[2];
+        ip_node_t ip_node(static_cast<uint16_t>(master.elements[1].integer), from.ip);
+        if (!master.elements[0].str.empty() && (master.elements[0].str != "?"))
+        {
+            try
+            {
+                ip_node.ip = master.elements[0].str.c_str();
+            }
+            catch (utils::CException& ex)
+            {
+                MYLOG_ERROR("invalid redis node %s: %s\n", master.elements[0].str.c_str(), ex.str().c_str());
+                continue;
+            }
+        }
+
+        for (int64_t slot=std::max<int64_t>(start, 0); (slot<=end) && (slot<REDIS_SLOT_NUMBER); ++slot)
+            slot_table[slot] = ip_node;
+    }
+
+    _slot_table.swap(slot_table);
+}
+
+// 处理MOVED和ASK，如MOVED 3999 127.0.0.1:6381，IP为空时表示同一节点的主机
+bool CRedisClient::redirect(CRedisConnection* connection, RedisRequest* request, const redis_reply_t& reply)
+{
+    const std::string& error = reply.str;
+    const bool moved = (0 == error.compare(0, 6, "MOVED "));
+    const bool ask = (0 == error.compare(0, 4, "ASK "));
+    if ((!moved && !ask) || (request->redirections >= REDIS_MAX_REDIRECTIONS))
+        return false;
+
+    const std::string::size_type space = error.find(' ', moved? 6: 4);
+    const std::string::size_type colon = error.rfind(':');
+    if ((std::string::npos == space) || (std::string::npos == colon) || (colon < space))
+        return false;
+
+    const int slot = atoi(error.c_str() + (moved? 6: 4));
+    const std::string host = error.substr(space+1, colon-space-1);
+    ip_node_t ip_node(static_cast<uint16_t>(atoi(error.c_str()+colon+1)), (NULL == connection)? _seeds[0].ip: connection->_ip_node.ip);
+    if (!host.empty())
+    {
+        try
+        {
+            ip_node.ip = host.c_str();
+        }
+        catch (utils::CException& ex)
+        {
+            MYLOG_ERROR("invalid redirection %s: %s\n", error.c_str(), ex.str().c_str());
+            return false;
+        }
+    }
+
+    ++request->redirections;
+    if (moved)
+    {
+        ++_moved_number;
+        if (!_slot_table.empty() && (slot >= 0) && (slot < REDIS_SLOT_NUMBER))
+            _slot_table[slot] = ip_node;
+        refresh_slots(&ip_node);
+        send_to(ip_node, request);
+    }
+    else
+    {
+        // ASKING只对紧随其后的一个命令有效，同一连接上两者相邻
+        CRedisConnection* target = get_connection(ip_node);
+        ++_ask_number;
+        target->enqueue(new_request(request_asking, std::vector<std::string>(1, "ASKING"), _timeout));
+        target->enqueue(request);
+        mark_dirty(target);
+    }
+
+    return true;
+}
+
+void CRedisClient::on_reply(CRedisConnection* connection, RedisRequest* request, const redis_reply_t& reply)
+{
+    if (request_user == request->kind)
+    {
+        if (!_cluster || !reply.is_error() || _stopped || !redirect(connection, request, reply))
+            finish(request, reply);
+    }
+    else if (request_slots == request->kind)
+    {
+        std::vector<RedisRequest*> requests;
+        _slots_refreshing = false;
+        if (reply_array == reply.type)
+            update_slots(reply, (NULL == connection)? _seeds[0]: connection->_ip_node);
+        else
+            MYLOG_ERROR("get redis cluster slots error: %s\n", reply.str.c_str());
+
+        requests.swap(_slots_waiting);
+        for (std::vector<RedisRequest*>::size_type i=0; i<requests.size(); ++i)
+        {
+            if (_slot_table.empty())
+                finish(requests[i], reply.is_error()? reply: redis_reply_t(reply_error, "ERR no redis cluster slots"));
+            else
+                route(requests[i]);
+        }
+        delete request;
+    }
+    else
+    {
+        if ((request_hello == request->kind) && reply.is_error())
+            MYLOG_ERROR("redis HELLO 3 error: %s\n", reply.str.c_str());
+        delete request;
+    }
+}
+
+// 超时和服务端忙的应答是过载的信号，客户端自身停止的不计，其它错误应答（如WRONGTYPE）的耗时仍然有效
+static sys::limit_outcome_t get_limit_outcome(const redis_reply_t& reply)
+{
+    if (!reply.is_error())
+        return sys::limit_success;
+    if ((0 == reply.str.compare(0, 4, "BUSY")) || (0 == reply.str.compare(0, 7, "LOADING"))
+     || (0 == reply.str.compare(0, 8, "TRYAGAIN")) || (0 == reply.str.compare(0, 11, "CLUSTERDOWN"))
+     || (reply.str.find("timeout") != std::string::npos))
+        return sys::limit_dropped;
+    if (0 == reply.str.compare(0, 16, "ERR redis client"))
+        return sys::limit_ignored;
+    return sys::limit_success;
+}
+
+void CRedisClient::finish(RedisRequest* request, const redis_reply_t& reply)
+{
+    if (request->limited)
+        _limiter->release(request->ticket, get_limit_outcome(reply));
+    if (request->callback != NULL)
+        request->callback->on_reply(reply);
+    delete request;
+}
+
+// 连接不可用，在途和等待中的命令全部失败
+void CRedisClient::fail_connection(CRedisConnection* connection, const char* error)
+{
+    if (connection->_failed)
+        return;
+
+    const redis_reply_t reply(reply_error, error);
+    std::vector<RedisRequest*> requests(connection->_inflight.begin(), connection->_inflight.end());
+    requests.insert(requests.end(), connection->_pending.begin(), connection->_pending.end());
+    connection->_inflight.clear();
+    connection->_pending.clear();
+
+    MYLOG_ERROR("redis connection %s failed with %zu requests: %s\n", connection->_ip_node.ip.to_string().c_str(), requests.size(), error);
+    _connection_table.erase(connection->_ip_node);
+    release_connection(connection, true);
+    for (std::vector<RedisRequest*>::size_type i=0; i<requests.size(); ++i)
+        on_reply(NULL, requests[i], reply);
+}
+
+// 连接对象延迟到flush_dirty时才释放，此前可能还在_dirty_connections中
+void CRedisClient::release_connection(CRedisConnection* connection, bool broken)
+{
+    connection->_failed = true;
+    if (connection->_client != NULL)
+    {
+        _event_loop->remove(connection, false);
+        _client_pool->pay_back(connection->detach(), broken);
+    }
+    _dead_connections.push_back(connection);
+}
+
+void CRedisClient::mark_dirty(CRedisConnection* connection)
+{
+    if (!connection->_dirty)
+    {
+        connection->_dirty = true;
+        _dirty_connections.push_back(connection);
+    }
+}
+
+// 发送所有连接积攒的命令，每个连接一次send，并释放已失效的连接
+void CRedisClient::flush_dirty()
+{
+    for (std::vector<CRedisConnection*>::size_type i=0; i<_dirty_connections.size(); ++i)
+    {
+        CRedisConnection* connection = _dirty_connections[i];
+        connection->_dirty = false;
+        if (!connection->_failed && (connection->_client != NULL) && !connection->flush())
+            fail_connection(connection, "ERR send to redis failed");
+    }
+    _dirty_connections.clear();
+
+    for (std::vector<CRedisConnection*>::size_type i=0; i<_dead_connections.size(); ++i)
+        _dead_connections[i]->dec_refcount();
+    _dead_connections.clear();
+}
+
+CRedisConnection* CRedisClient::get_connection(const ip_node_t& ip_node)
+{
+    connection_table_t::iterator iter = _connection_table.find(ip_node);
+    if (iter != _connection_table.end())
+        return iter->second;
+
+    CRedisConnection* connection = new CRedisConnection(this, ip_node);
+    connection->inc_refcount();
+    _connection_table.insert(std::make_pair(ip_node, connection));
+    (void)connection->try_connect();
+    return connection;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+class CHedgedAttemptCallback;
+
+// 一个对冲的只读命令，由定时器和各次发出的命令共同引用
+class CHedgedRedisRequest: public ITimerHandler
+{
+public:
+    CHedgedRedisRequest(CHedgedRedisClient* hedged_client, const std::vector<std::string>& args, IRedisCallback* callback, uint32_t primary)
+        : _hedged_client(hedged_client), _args(args), _callback(callback), _primary(primary),
+          _start_nanoseconds(sys::CClock::get_nanoseconds()), _delay_milliseconds(0),
+          _references(1), _outstanding(0), _done(false)
+    {
+    }
+
+    uint32_t get_delay_milliseconds() const { return _delay_milliseconds; }
+    void set_delay_milliseconds(uint32_t milliseconds) { _delay_milliseconds = milliseconds; }
+
+    bool is_done()
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        return _done;
+    }
+
+    // 发给第attempt个副本，0为首次
+    void send(uint32_t attempt);
+
+    // 出错的应答只在没有其它在途的命令时才交给调用者，以便对冲的仍有机会成功
+    void on_attempt_reply(uint32_t attempt, const redis_reply_t& reply)
+    {
+        bool deliver;
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            --_outstanding;
+            deliver = !_done && (!reply.is_error() || (0 == _outstanding));
+            if (deliver)
+                _done = true;
+        }
+
+        if (deliver)
+        {
+            if (!reply.is_error())
+                _hedged_client->_controller->on_complete(sys::CClock::get_nanoseconds() - _start_nanoseconds, attempt != 0);
+            if (_callback != NULL)
+                _callback->on_reply(reply);
+        }
+        release();
+    }
+
+    void release()
+    {
+        if (0 == __atomic_sub_fetch(&_references, 1, __ATOMIC_ACQ_REL))
+            delete this;
+    }
+
+private:
+    // 对冲延迟到期，释放定时器的引用
+    virtual uint32_t on_timer(CEventLoop* event_loop, uint64_t timer_id)
+    {
+        if (!is_done() && _hedged_client->_controller->try_hedge())
+            send(1);
+        release();
+        return 0;
+    }
+
+private:
+    CHedgedRedisClient* _hedged_client;
+    const std::vector<std::string> _args;
+    IRedisCallback* _callback;
+    const uint32_t _primary;
+    const uint64_t _start_nanoseconds;
+    uint32_t _delay_milliseconds;
+    uint32_t _references;
+    sys::CLock _lock;
+    uint32_t _outstanding; /** 已发出未应答的命令数 */
+    bool _done;            /** 是否已回调调用者 */
+};
+
+// 一次发出的命令的应答
+class CHedgedAttemptCallback: public IRedisCallback
+{
+public:
+    CHedgedAttemptCallback(CHedgedRedisRequest* request, uint32_t attempt)
+        : _request(request), _attempt(attempt)
+    {
+    }
+
+private:
+    virtual void on_reply(const redis_reply_t& reply)
+    {
+        _request->on_attempt_reply(_attempt, reply);
+        delete this;
+    }
+
+private:
+    CHedgedRedisRequest* _request;
+    uint32_t _attempt;
+};
+
+void CHedgedRedisRequest::send(uint32_t attempt)
+{
+    const std::vector<CRedisClient*>& replicas = _hedged_client->_replicas;
+    CRedisClient* redis_client = replicas[(_primary + attempt) % replicas.size()];
+
+    __atomic_add_fetch(&_references, 1, __ATOMIC_ACQ_REL);
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        ++_outstanding;
+    }
+    redis_client->async_command(_args, new CHedgedAttemptCallback(this, attempt));
+}
+
+CHedgedRedisClient::CHedgedRedisClient(CEventLoop* event_loop, sys::CHedgeController* controller)
+    : _event_loop(event_loop), _controller(controller), _next_replica(0)
+{
+}
+
+void CHedgedRedisClient::add_replica(CRedisClient* redis_client)
+{
+    _replicas.push_back(redis_client);
+}
+
+void CHedgedRedisClient::async_read(const std::vector<std::string>& args, IRedisCallback* callback)
+{
+    const uint32_t primary = __atomic_fetch_add(&_next_replica, 1, __ATOMIC_RELAXED) % _replicas.size();
+    if (_replicas.size() < 2)
+    {
+        _replicas[primary]->async_command(args, callback);
+        return;
+    }
+
+    // 初始的引用属于定时器，定时器只能在事件循环线程中加入
+    CHedgedRedisRequest* request = new CHedgedRedisRequest(this, args, callback, primary);
+    request->set_delay_milliseconds(_controller->on_request());
+    request->send(0);
+    _event_loop->post(utils::bind<void>(&CHedgedRedisClient::schedule, this, request));
+}
+
+bool CHedgedRedisClient::read(const std::vector<std::string>& args, redis_reply_t* reply, uint32_t milliseconds)
+{
+    CSyncCallback* callback = new CSyncCallback;
+    async_read(args, callback);
+    return callback->wait(reply, milliseconds);
+}
+
+void CHedgedRedisClient::schedule(CHedgedRedisRequest* request)
+{
+    if (request->is_done())
+        request->release();
+    else
+        (void)_event_loop->run_after(request->get_delay_milliseconds(), request);
+}
+
+NET_NAMESPACE_END
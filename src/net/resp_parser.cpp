@@ -0,0 +1,285 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/resp_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+NET_NAMESPACE_BEGIN
+
+// 找不到行结束符时，一行最多允许的字节数，超过视为格式错误
+#define RESP_LINE_MAX 65536
+
+// 块字符串最大字节数，同Redis的proto-max-bulk-len默认值
+#define RESP_BULK_MAX (512*1024*1024LL)
+
+// 一个聚合类型最多的成员数
+#define RESP_ELEMENTS_MAX (64*1024*1024LL)
+
+static bool to_int64(std::string_view value, int64_t* result)
+{
+    size_t i = 0;
+    bool negative = false;
+    int64_t number = 0;
+
+    if (!value.empty() && (('-' == value[0]) || ('+' == value[0])))
+    {
+        negative = ('-' == value[0]);
+        i = 1;
+    }
+    if (i >= value.size())
+        return false;
+
+    for (; i<value.size(); ++i)
+    {
+        if ((value[i] < '0') || (value[i] > '9'))
+            return false;
+        number = number * 10 + (value[i] - '0');
+    }
+
+    *result = negative? -number: number;
+    return true;
+}
+
+void redis_reply_t::clear()
+{
+    type = reply_nil;
+    str.clear();
+    integer = 0;
+    number = 0;
+    elements.clear();
+}
+
+CRespParser::CRespParser()
+{
+    _stack.reserve(4);
+}
+
+int CRespParser::parse(const char* data, size_t size, size_t* consumed, redis_reply_t* reply)
+{
+    size_t offset = 0;
+
+    while (offset < size)
+    {
+        const char* line = data + offset;
+        const char* lf = static_cast<const char*>(memchr(line, '\n', size - offset));
+        if (NULL == lf)
+        {
+            if (size - offset > RESP_LINE_MAX)
+                return -1;
+            break;
+        }
+        if ((lf - line < 2) || (lf[-1] != '\r'))
+            return -1;
+
+        const char type = line[0];
+        const std::string_view value(line + 1, lf - line - 2);
+        size_t next = lf + 1 - data;
+        redis_reply_t* target = get_target();
+        int64_t length = 0;
+
+        switch (type)
+        {
+        case '+':
+        case '-':
+        case '(':
+            target->clear();
+            target->type = ('+' == type)? reply_status: (('-' == type)? reply_error: reply_big_number);
+            target->str.assign(value);
+            break;
+        case ':':
+            if (!to_int64(value, &length))
+                return -1;
+            target->clear();
+            target->type = reply_integer;
+            target->integer = length;
+            break;
+        case '_':
+            target->clear();
+            break;
+        case '#':
+            if ((value != "t") && (value != "f"))
+                return -1;
+            target->clear();
+            target->type = reply_boolean;
+            target->integer = ("t" == value)? 1: 0;
+            break;
+        case ',':
+        {
+            // 包括inf、-inf和nan
+            const std::string number(value);
+            char* end = NULL;
+            target->clear();
+            target->type = reply_double;
+            target->number = strtod(number.c_str(), &end);
+            if (number.empty() || (*end != '\0'))
+                return -1;
+            break;
+        }
+        case '$':
+        case '!':
+        case '=':
+            if (!to_int64(value, &length) || (length > RESP_BULK_MAX))
+                return -1;
+            target->clear();
+            if (length < 0)
+            {
+                if (type != '$')
+                    return -1;
+                break; // RESP2的空值$-1
+            }
+
+            // 块字符串不完整时，连同长度行留待下次
+            if (size - next < static_cast<size_t>(length) + 2)
+            {
+                *consumed = offset;
+                return 0;
+            }
+            if (('\r' != data[next+length]) || ('\n' != data[next+length+1]))
+                return -1;
+
+            target->type = ('$' == type)? reply_string: (('!' == type)? reply_error: reply_verbatim);
+            if ((reply_verbatim == target->type) && (length >= 4) && (':' == data[next+3]))
+                target->str.assign(data + next + 4, length - 4);
+            else
+                target->str.assign(data + next, length);
+            next += length + 2;
+            break;
+        case '*':
+        case '%':
+        case '~':
+        case '>':
+        case '|':
+        {
+            if (!to_int64(value, &length) || (length > RESP_ELEMENTS_MAX))
+                return -1;
+            if (length < 0)
+            {
+                if (type != '*')
+                    return -1;
+                target->clear(); // RESP2的空数组*-1
+                break;
+            }
+
+            const size_t number = static_cast<size_t>((('%' == type) || ('|' == type))? length*2: length);
+            Frame frame;
+            if ('|' == type)
+            {
+                // 属性不占位置，解析到单独的对象中，之后的值才是本位置的
+                _attributes.push_back(redis_reply_t());
+                frame.node = &_attributes.back();
+                frame.attribute = true;
+            }
+            else
+            {
+                target->clear();
+                target->type = ('*' == type)? reply_array: (('%' == type)? reply_map: (('~' == type)? reply_set: reply_push));
+                frame.node = target;
+                frame.attribute = false;
+            }
+
+            offset = next;
+            if (number > 0)
+            {
+                frame.node->elements.resize(number);
+                frame.next = 0;
+                _stack.push_back(frame);
+                continue;
+            }
+            if (frame.attribute)
+            {
+                _attributes.pop_back();
+                continue;
+            }
+            break;
+        }
+        default:
+            return -1;
+        }
+
+        offset = next;
+        if (complete_value())
+        {
+            *consumed = offset;
+            std::swap(*reply, _root);
+            _root.clear();
+            return 1;
+        }
+    }
+
+    *consumed = offset;
+    return 0;
+}
+
+void CRespParser::reset()
+{
+    _root.clear();
+    _stack.clear();
+    _attributes.clear();
+}
+
+void CRespParser::format_command(const std::vector<std::string>& args, std::string* output)
+{
+    char header[32];
+    size_t size = 16;
+
+    for (std::vector<std::string>::size_type i=0; i<args.size(); ++i)
+        size += args[i].size() + 16;
+    output->reserve(output->size() + size);
+
+    output->append(header, snprintf(header, sizeof(header), "*%zu\r\n", args.size()));
+    for (std::vector<std::string>::size_type i=0; i<args.size(); ++i)
+    {
+        output->append(header, snprintf(header, sizeof(header), "$%zu\r\n", args[i].size()));
+        output->append(args[i]);
+        output->append("\r\n", 2);
+    }
+}
+
+redis_reply_t* CRespParser::get_target()
+{
+    if (_stack.empty())
+        return &_root;
+
+    Frame& top = _stack.back();
+    return &top.node->elements[top.next];
+}
+
+// 一个值解析完成，逐层向上推进，返回true表示整个应答已完成
+bool CRespParser::complete_value()
+{
+    for (;;)
+    {
+        if (_stack.empty())
+            return true;
+
+        Frame& top = _stack.back();
+        if (++top.next < top.node->elements.size())
+            return false;
+
+        const bool attribute = top.attribute;
+        _stack.pop_back();
+        if (attribute)
+        {
+            _attributes.pop_back();
+            return false;
+        }
+    }
+}
+
+NET_NAMESPACE_END
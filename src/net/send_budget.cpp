@@ -0,0 +1,54 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/send_budget.h"
+NET_NAMESPACE_BEGIN
+
+CSendBudget* CSendBudget::get_singleton()
+{
+    // 不释放，以便其它全局对象析构时仍可使用
+    static CSendBudget* budget = new CSendBudget;
+    return budget;
+}
+
+CSendBudget::CSendBudget()
+    : _limit(0)
+{
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    _bytes = registry->get_gauge("send_queue.bytes");
+    _paused = registry->get_gauge("send_queue.paused");
+    _over_budget = registry->get_counter("send_queue.over_budget");
+}
+
+bool CSendBudget::is_exceeded() const
+{
+    const size_t limit = get_limit();
+    return (limit > 0) && (get_bytes() > limit);
+}
+
+// 只在从预算内跨到预算外时计数，而不是超出期间的每次push
+void CSendBudget::add(size_t bytes)
+{
+    const size_t limit = get_limit();
+    const size_t new_bytes = static_cast<size_t>(_bytes->add(static_cast<int64_t>(bytes)));
+
+    if ((limit > 0) && (new_bytes > limit) && (new_bytes - bytes <= limit))
+        _over_budget->inc();
+}
+
+NET_NAMESPACE_END
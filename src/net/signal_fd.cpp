@@ -0,0 +1,79 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/signal_fd.h"
+NET_NAMESPACE_BEGIN
+
+// 一次最多读取的信号个数
+#define SIGNAL_NUMBER_READ_ONCE 16
+
+CSignalFd::CSignalFd(sys::ISignalObserver* observer)
+    : _observer(observer)
+{
+}
+
+void CSignalFd::create()
+{
+    sigset_t sigset;
+    if (!sys::CSignalHandler::get_blocked_signals(&sigset))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "sigaddset");
+
+    create(sigset);
+}
+
+void CSignalFd::create(const sigset_t& sigset)
+{
+    const int fd = signalfd(get_fd(), &sigset, SFD_NONBLOCK|SFD_CLOEXEC);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "signalfd");
+
+    set_fd(fd);
+}
+
+int CSignalFd::read_signals(struct signalfd_siginfo* siginfos, int max_number)
+{
+    while (true)
+    {
+        const ssize_t bytes = read(get_fd(), siginfos, sizeof(struct signalfd_siginfo) * max_number);
+        if (bytes != -1)
+            return static_cast<int>(bytes / sizeof(struct signalfd_siginfo));
+        if (EAGAIN == errno)
+            return 0;
+        if (errno != EINTR)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
+    }
+}
+
+epoll_event_t CSignalFd::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    struct signalfd_siginfo siginfos[SIGNAL_NUMBER_READ_ONCE];
+
+    while (true)
+    {
+        // 读满一批时可能还有，继续读，直到读空
+        const int number = read_signals(siginfos, SIGNAL_NUMBER_READ_ONCE);
+        for (int i=0; i<number; ++i)
+            sys::CSignalHandler::dispatch(_observer, static_cast<int>(siginfos[i].ssi_signo));
+        if (number < SIGNAL_NUMBER_READ_ONCE)
+            break;
+    }
+
+    return epoll_none;
+}
+
+NET_NAMESPACE_END
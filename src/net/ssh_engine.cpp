@@ -0,0 +1,525 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/ssh_engine.h"
+#include "net/epoller.h"
+#include "sys/thread_engine.h"
+#include "utils/string_utils.h"
+#include "utils/timing_wheel.h"
+#include <arpa/inet.h>
+#include <time.h>
+#if MOOON_HAVE_LIBSSH2 == 1
+#include <libssh2.h>
+#endif // MOOON_HAVE_LIBSSH2
+NET_NAMESPACE_BEGIN
+
+CSshEngine::CSshEngine(ISshObserver* observer, int num_threads)
+    : _observer(observer), _num_threads((num_threads < 1)? 1: num_threads),
+      _timeout_seconds(0), _max_sessions(0), _max_connects_per_second(0)
+{
+}
+
+size_t CSshEngine::add_host(const std::string& ip, uint16_t port)
+{
+    _hosts.push_back(std::make_pair(ip, port));
+    return _hosts.size() - 1;
+}
+
+#if MOOON_HAVE_LIBSSH2 == 1
+
+static int64_t get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static std::string get_session_errmsg(LIBSSH2_SESSION* session)
+{
+    char* errmsg = NULL;
+    int errmsg_len = 0;
+
+    (void)libssh2_session_last_error(session, &errmsg, &errmsg_len, 0);
+    return (NULL == errmsg)? std::string(): std::string(errmsg, errmsg_len);
+}
+
+// 所有主机共用的执行参数
+struct SshContext
+{
+    std::string username;
+    std::string password;
+    std::string command;
+};
+
+// 一台主机的一次执行，状态机由CSshExecutor按socket事件推进
+class CSshTask: public CEpollable, public utils::CWheelTimeoutable
+{
+public:
+    CSshTask(const struct SshContext* context, size_t index, const std::string& ip, uint16_t port);
+    ~CSshTask();
+
+    // 发起非阻塞连接，失败时返回false，出错信息在结果中
+    bool start();
+
+    // 推进状态机直到需要等待socket，返回true表示已结束（成功或失败）
+    bool step();
+
+    // 继续推进需要等待的epoll事件
+    int get_wanted_events() const;
+
+    void fail(const std::string& errmsg) { _result.errmsg = errmsg; _stage = stage_done; }
+    struct SshResult& get_result() { return _result; }
+    const std::string& get_password() const { return _context->password; }
+
+private:
+    enum Stage
+    {
+        stage_connect,
+        stage_handshake,
+        stage_auth_list,
+        stage_auth_password,
+        stage_auth_keyboard,
+        stage_open,
+        stage_exec,
+        stage_read,
+        stage_close,
+        stage_done
+    };
+
+private:
+    const struct SshContext* _context;
+    Stage _stage;
+    LIBSSH2_SESSION* _session;
+    LIBSSH2_CHANNEL* _channel;
+    int64_t _start_milliseconds;
+    struct SshResult _result;
+};
+
+// abstract为libssh2_session_init_ex时传入的CSshTask
+static void kbd_callback(const char *name, int name_len,
+                         const char *instruction, int instruction_len,
+                         int num_prompts,
+                         const LIBSSH2_USERAUTH_KBDINT_PROMPT *prompts,
+                         LIBSSH2_USERAUTH_KBDINT_RESPONSE *responses,
+                         void **abstract)
+{
+    (void)name;
+    (void)name_len;
+    (void)instruction;
+    (void)instruction_len;
+    (void)prompts;
+    if (1 == num_prompts)
+    {
+        const std::string& password = static_cast<CSshTask*>(*abstract)->get_password();
+        responses[0].text = strdup(password.c_str());
+        responses[0].length = password.size();
+    }
+}
+
+CSshTask::CSshTask(const struct SshContext* context, size_t index, const std::string& ip, uint16_t port)
+    : _context(context), _stage(stage_connect), _session(NULL), _channel(NULL), _start_milliseconds(get_monotonic_milliseconds())
+{
+    _result.index = index;
+    _result.ip = ip;
+    _result.port = port;
+}
+
+CSshTask::~CSshTask()
+{
+    if (_channel != NULL)
+        (void)libssh2_channel_free(_channel);
+    if (_session != NULL)
+    {
+        // 非阻塞方式下只尽力发送一次断开通知
+        (void)libssh2_session_disconnect(_session, "normal Shutdown");
+        (void)libssh2_session_free(_session);
+    }
+}
+
+bool CSshTask::start()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_result.port);
+    if (inet_pton(AF_INET, _result.ip.c_str(), &addr.sin_addr) != 1)
+    {
+        fail("invalid ip");
+        return false;
+    }
+
+    const int fd = socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (-1 == fd)
+    {
+        fail(utils::CStringUtils::format_string("socket failed: %s", strerror(errno)));
+        return false;
+    }
+
+    set_fd(fd);
+    if ((-1 == connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))) && (errno != EINPROGRESS))
+    {
+        fail(utils::CStringUtils::format_string("connect failed: %s", strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+bool CSshTask::step()
+{
+    for (;;)
+    {
+        int errcode;
+
+        switch (_stage)
+        {
+        case stage_connect:
+            errcode = get_socket_error_code();
+            if (errcode != 0)
+            {
+                fail(utils::CStringUtils::format_string("connect failed: %s", strerror(errcode)));
+                break;
+            }
+
+            _session = libssh2_session_init_ex(NULL, NULL, NULL, this);
+            if (NULL == _session)
+            {
+                fail("libssh2_session_init_ex failed");
+                break;
+            }
+            libssh2_session_set_blocking(_session, 0);
+            _stage = stage_handshake;
+            break;
+
+        case stage_handshake:
+            errcode = libssh2_session_handshake(_session, get_fd());
+            if (LIBSSH2_ERROR_EAGAIN == errcode)
+                return false;
+            if (errcode != 0)
+                fail(get_session_errmsg(_session));
+            else
+                _stage = stage_auth_list;
+            break;
+
+        case stage_auth_list:
+        {
+            const char* userauth_list = libssh2_userauth_list(_session, _context->username.c_str(), _context->username.size());
+            if (NULL == userauth_list)
+            {
+                if (LIBSSH2_ERROR_EAGAIN == libssh2_session_last_errno(_session))
+                    return false;
+                if (libssh2_userauth_authenticated(_session)) // 服务端接受了none方式
+                    _stage = stage_open;
+                else
+                    fail(get_session_errmsg(_session));
+            }
+            else if (strstr(userauth_list, "password") != NULL)
+            {
+                _stage = stage_auth_password;
+            }
+            else if (strstr(userauth_list, "keyboard-interactive") != NULL)
+            {
+                _stage = stage_auth_keyboard;
+            }
+            else
+            {
+                fail("no supported methods, please configure sshd with password or keyboard interactive");
+            }
+            break;
+        }
+
+        case stage_auth_password:
+        case stage_auth_keyboard:
+            if (stage_auth_password == _stage)
+                errcode = libssh2_userauth_password(_session, _context->username.c_str(), _context->password.c_str());
+            else
+                errcode = libssh2_userauth_keyboard_interactive(_session, _context->username.c_str(), &kbd_callback);
+            if (LIBSSH2_ERROR_EAGAIN == errcode)
+                return false;
+            if (errcode != 0)
+                fail(get_session_errmsg(_session));
+            else
+                _stage = stage_open;
+            break;
+
+        case stage_open:
+            _channel = libssh2_channel_open_session(_session);
+            if (NULL == _channel)
+            {
+                if (LIBSSH2_ERROR_EAGAIN == libssh2_session_last_errno(_session))
+                    return false;
+                fail(get_session_errmsg(_session));
+            }
+            else
+            {
+                _stage = stage_exec;
+            }
+            break;
+
+        case stage_exec:
+            errcode = libssh2_channel_exec(_channel, _context->command.c_str());
+            if (LIBSSH2_ERROR_EAGAIN == errcode)
+                return false;
+            if (errcode != 0)
+                fail(get_session_errmsg(_session));
+            else
+                _stage = stage_read;
+            break;
+
+        case stage_read:
+        {
+            char buffer[4096];
+            const ssize_t bytes = libssh2_channel_read(_channel, buffer, sizeof(buffer));
+            if (bytes > 0)
+            {
+                _result.output.append(buffer, bytes);
+                break;
+            }
+            if ((bytes < 0) && (bytes != LIBSSH2_ERROR_EAGAIN))
+            {
+                fail(get_session_errmsg(_session));
+                break;
+            }
+
+            // 标准错误须读走，否则通道窗口被占满后命令会卡住
+            while (libssh2_channel_read_stderr(_channel, buffer, sizeof(buffer)) > 0);
+            if (!libssh2_channel_eof(_channel))
+                return false;
+            _stage = stage_close;
+            break;
+        }
+
+        case stage_close:
+            errcode = libssh2_channel_close(_channel);
+            if (LIBSSH2_ERROR_EAGAIN == errcode)
+                return false;
+            if (errcode != 0)
+            {
+                fail(get_session_errmsg(_session));
+            }
+            else
+            {
+                char* exitsignal = NULL;
+
+                _result.exitcode = libssh2_channel_get_exit_status(_channel);
+                (void)libssh2_channel_get_exit_signal(_channel, &exitsignal, NULL, NULL, NULL, NULL, NULL);
+                if (exitsignal != NULL)
+                {
+                    _result.exitsignal = exitsignal;
+                    free(exitsignal);
+                }
+                _stage = stage_done;
+            }
+            break;
+
+        case stage_done:
+            _result.milliseconds = static_cast<uint32_t>(get_monotonic_milliseconds() - _start_milliseconds);
+            return true;
+        }
+    }
+}
+
+int CSshTask::get_wanted_events() const
+{
+    if (stage_connect == _stage)
+        return EPOLLOUT;
+
+    int events = 0;
+    const int direction = libssh2_session_block_directions(_session);
+    if (direction & LIBSSH2_SESSION_BLOCK_INBOUND)
+        events |= EPOLLIN;
+    if (direction & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+        events |= EPOLLOUT;
+    return (0 == events)? EPOLLIN: events;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 一个执行线程，用一个CEpoller驱动分给它的所有主机
+class CSshExecutor: public utils::ITimeoutHandler<CSshTask>
+{
+public:
+    CSshExecutor(const struct SshContext* context, ISshObserver* observer, uint32_t timeout_seconds, uint32_t max_sessions, uint32_t max_connects_per_second);
+
+    void add_host(size_t index, const std::string& ip, uint16_t port);
+    void run();
+
+private:
+    virtual void on_timeout_event(CSshTask* task);
+    void start_sessions(int64_t current_milliseconds);
+    void finish(CSshTask* task);
+
+private:
+    const struct SshContext* _context;
+    ISshObserver* _observer;
+    uint32_t _timeout_seconds;
+    uint32_t _max_sessions;
+    uint32_t _max_connects_per_second;
+    std::vector<std::pair<size_t, std::pair<std::string, uint16_t> > > _hosts;
+    size_t _next_host;         // 下一台待连接的主机
+    uint32_t _num_sessions;    // 进行中的会话数
+    int64_t _second_start;     // 当前限速周期的开始时间
+    uint32_t _connects_in_second; // 当前限速周期内已新建的连接数
+    CEpoller _epoller;
+    utils::CTimingWheel<CSshTask> _timing_wheel;
+};
+
+CSshExecutor::CSshExecutor(const struct SshContext* context, ISshObserver* observer, uint32_t timeout_seconds, uint32_t max_sessions, uint32_t max_connects_per_second)
+    : _context(context), _observer(observer), _timeout_seconds(timeout_seconds),
+      _max_sessions(max_sessions), _max_connects_per_second(max_connects_per_second),
+      _next_host(0), _num_sessions(0), _second_start(0), _connects_in_second(0), _timing_wheel(10)
+{
+    _timing_wheel.set_timeout_handler(this);
+}
+
+void CSshExecutor::add_host(size_t index, const std::string& ip, uint16_t port)
+{
+    _hosts.push_back(std::make_pair(index, std::make_pair(ip, port)));
+}
+
+void CSshExecutor::run()
+{
+    uint32_t epoll_size = (_max_sessions > 0)? _max_sessions: static_cast<uint32_t>(_hosts.size());
+    _epoller.create((epoll_size < 64)? 64: epoll_size);
+
+    while ((_next_host < _hosts.size()) || (_num_sessions > 0))
+    {
+        start_sessions(get_monotonic_milliseconds());
+
+        // 受限速或并发限制而有主机在等待时，缩短等待以便及时发起新连接
+        const int n = _epoller.timed_wait((_next_host < _hosts.size())? 10: 100);
+        for (int i=0; i<n; ++i)
+        {
+            CSshTask* task = static_cast<CSshTask*>(_epoller.get(i));
+            if (task->step())
+                finish(task);
+            else
+                _epoller.set_events(task, task->get_wanted_events());
+        }
+
+        _timing_wheel.check_timeout(get_monotonic_milliseconds());
+    }
+
+    _epoller.destroy();
+}
+
+void CSshExecutor::on_timeout_event(CSshTask* task)
+{
+    task->fail(utils::CStringUtils::format_string("timeout after %u seconds", _timeout_seconds));
+    (void)task->step();
+    finish(task);
+}
+
+void CSshExecutor::start_sessions(int64_t current_milliseconds)
+{
+    if (current_milliseconds - _second_start >= 1000)
+    {
+        _second_start = current_milliseconds;
+        _connects_in_second = 0;
+    }
+
+    while (_next_host < _hosts.size())
+    {
+        if ((_max_sessions > 0) && (_num_sessions >= _max_sessions))
+            break;
+        if ((_max_connects_per_second > 0) && (_connects_in_second >= _max_connects_per_second))
+            break;
+
+        const std::pair<size_t, std::pair<std::string, uint16_t> >& host = _hosts[_next_host++];
+        CSshTask* task = new CSshTask(_context, host.first, host.second.first, host.second.second);
+
+        ++_connects_in_second;
+        ++_num_sessions;
+        if (!task->start())
+        {
+            (void)task->step();
+            finish(task);
+            continue;
+        }
+
+        if (_timeout_seconds > 0)
+            _timing_wheel.push(task, current_milliseconds, _timeout_seconds*1000);
+        _epoller.set_events(task, task->get_wanted_events());
+    }
+}
+
+void CSshExecutor::finish(CSshTask* task)
+{
+    _timing_wheel.remove(task);
+    if (task->get_epoll_events() != 0)
+        _epoller.del_events(task);
+    --_num_sessions;
+
+    _observer->on_finished(task->get_result());
+    delete task;
+}
+
+void CSshEngine::execute(const std::string& username, const std::string& password, const std::string& command)
+{
+    struct SshContext context;
+    context.username = username;
+    context.password = password;
+    context.command = command;
+
+    // 并发和限速的上限平分给各线程，不足1的按1
+    const int num_threads = (_hosts.size() < static_cast<size_t>(_num_threads))? static_cast<int>(_hosts.size()): _num_threads;
+    const uint32_t max_sessions = (0 == _max_sessions)? 0: (_max_sessions + num_threads - 1) / num_threads;
+    const uint32_t max_connects_per_second = (0 == _max_connects_per_second)? 0: (_max_connects_per_second + num_threads - 1) / num_threads;
+    std::vector<CSshExecutor*> executors(num_threads);
+    for (int i=0; i<num_threads; ++i)
+        executors[i] = new CSshExecutor(&context, _observer, _timeout_seconds, max_sessions, max_connects_per_second);
+    for (std::vector<std::pair<std::string, uint16_t> >::size_type i=0; i<_hosts.size(); ++i)
+        executors[i % num_threads]->add_host(i, _hosts[i].first, _hosts[i].second);
+
+    try
+    {
+        if (1 == num_threads)
+        {
+            executors[0]->run();
+        }
+        else if (num_threads > 1)
+        {
+            std::vector<sys::CThreadEngine*> thread_engines(num_threads);
+            for (int i=0; i<num_threads; ++i)
+                thread_engines[i] = new sys::CThreadEngine(sys::bind(&CSshExecutor::run, executors[i]));
+            for (int i=0; i<num_threads; ++i)
+            {
+                thread_engines[i]->join();
+                delete thread_engines[i];
+            }
+        }
+    }
+    catch (...)
+    {
+        for (int i=0; i<num_threads; ++i)
+            delete executors[i];
+        throw;
+    }
+
+    for (int i=0; i<num_threads; ++i)
+        delete executors[i];
+}
+
+#else
+
+void CSshEngine::execute(const std::string& username, const std::string& password, const std::string& command)
+{
+    THROW_EXCEPTION("not implement, please install libssh2 and recompile", -1);
+}
+
+#endif // MOOON_HAVE_LIBSSH2
+NET_NAMESPACE_END
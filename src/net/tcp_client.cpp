@@ -19,7 +19,15 @@
 #include "mooon/net/tcp_client.h"
 #include "data_channel.h"
 #include "mooon/net/utils.h"
+#include "mooon/sys/clock.h"
+#include <netinet/tcp.h>
 #include <sstream>
+#if __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif // SOL_TLS
+#endif // linux/tls.h
 #define CONNECT_UNESTABLISHED 0
 #define CONNECT_ESTABLISHED   1
 #define CONNECT_ESTABLISHING  2
@@ -29,6 +37,8 @@ CTcpClient::CTcpClient()
 	:_peer_port(0)
 	,_milli_seconds(0)
 	,_connect_state(CONNECT_UNESTABLISHED)
+    ,_fast_open(false)
+    ,_bind_local(false)
 {
 	_data_channel = new CDataChannel;
     atomic_set(&_reconnect_times, 0);
@@ -128,38 +138,90 @@ void CTcpClient::on_connect_failure()
     // 子类可以选择去做点事
 }
 
-bool CTcpClient::do_connect(int& fd, bool nonblock)
-{   
-    // 方便在连接之前做一些处理
-    if (!before_connect()) return false;
-    
-    fd = socket(AF_INET, SOCK_STREAM, 0);
+// 绑定本端IP，端口推迟到connect时分配，否则bind时就得选定端口，每个本端IP的连接总数不能超过临时端口数
+static void bind_local(int fd, const ip_address_t& local_ip)
+{
+#if defined(IP_BIND_ADDRESS_NO_PORT)
+    int enable = 1;
+    (void)setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enable, sizeof(enable));
+#endif // IP_BIND_ADDRESS_NO_PORT
+
+    int retval;
+    const uint32_t* ip_data = local_ip.get_address_data();
+    if (local_ip.is_ipv6())
+    {
+        struct sockaddr_in6 local_addr_in6;
+        memset(&local_addr_in6, 0, sizeof(local_addr_in6));
+        local_addr_in6.sin6_family = AF_INET6;
+        memcpy(&local_addr_in6.sin6_addr, ip_data, sizeof(local_addr_in6.sin6_addr));
+        retval = bind(fd, (struct sockaddr*)&local_addr_in6, sizeof(local_addr_in6));
+    }
+    else
+    {
+        struct sockaddr_in local_addr_in;
+        memset(&local_addr_in, 0, sizeof(local_addr_in));
+        local_addr_in.sin_family = AF_INET;
+        local_addr_in.sin_addr.s_addr = ip_data[0];
+        retval = bind(fd, (struct sockaddr*)&local_addr_in, sizeof(local_addr_in));
+    }
+    if (-1 == retval)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "bind");
+}
+
+// 创建SOCKET并向ip:port发起连接，fd总是返回创建的SOCKET，local_ip不为NULL时先绑定本端IP
+static bool connect_to(const ip_address_t& ip, uint16_t port, bool nonblock, bool fast_open, const ip_address_t* local_ip, int& fd)
+{
+    fd = socket(ip.is_ipv6()? AF_INET6: AF_INET, SOCK_STREAM, 0);
     if (-1 == fd)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "socket");
+    if ((local_ip != NULL) && (local_ip->is_ipv6() == ip.is_ipv6()))
+    {
+        // 绑定失败（如本端IP不存在）时由这里关闭，调用者不必区分
+        try
+        {
+            bind_local(fd, *local_ip);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            ::close(fd);
+            fd = -1;
+            throw;
+        }
+    }
 
     if (nonblock)
         net::set_nonblock(fd, true);
 
+#if defined(TCP_FASTOPEN_CONNECT)
+    // 内核不支持（4.11之前）时忽略，仍为普通的连接
+    if (fast_open)
+    {
+        int enable = 1;
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enable, sizeof(enable));
+    }
+#endif // TCP_FASTOPEN_CONNECT
+
     socklen_t addr_length;
     struct sockaddr* peer_addr;
     struct sockaddr_in peer_addr_in;
     struct sockaddr_in6 peer_addr_in6;    
             
-    const uint32_t* ip_data = _peer_ip.get_address_data();
-    if (_peer_ip.is_ipv6())
+    const uint32_t* ip_data = ip.get_address_data();
+    if (ip.is_ipv6())
     {
         addr_length = sizeof(struct sockaddr_in6);
         peer_addr = (struct sockaddr*)&peer_addr_in6;        
+        memset(&peer_addr_in6, 0, sizeof(peer_addr_in6));
         peer_addr_in6.sin6_family = AF_INET6;
-        peer_addr_in6.sin6_port = htons(_peer_port);
-        memcpy(&peer_addr_in6.sin6_addr, ip_data, addr_length);
+        peer_addr_in6.sin6_port = htons(port);
+        memcpy(&peer_addr_in6.sin6_addr, ip_data, sizeof(peer_addr_in6.sin6_addr));
     }
     else
     {
         addr_length = sizeof(struct sockaddr_in);
         peer_addr = (struct sockaddr*)&peer_addr_in;
 	    peer_addr_in.sin_family = AF_INET;
-        peer_addr_in.sin_port = htons(_peer_port);
+        peer_addr_in.sin_port = htons(port);
         peer_addr_in.sin_addr.s_addr = ip_data[0];
         memset(peer_addr_in.sin_zero, 0, sizeof(peer_addr_in.sin_zero));
     }	
@@ -167,6 +229,19 @@ bool CTcpClient::do_connect(int& fd, bool nonblock)
     return (0 == connect(fd, peer_addr, addr_length)) || (EISCONN == errno);
 }
 
+bool CTcpClient::do_connect(int& fd, bool nonblock)
+{   
+    // 方便在连接之前做一些处理
+    if (!before_connect()) return false;
+    
+    return connect_to(_peer_ip, _peer_port, nonblock, _fast_open, _bind_local? &_local_ip: NULL, fd);
+}
+
+bool CTcpClient::enable_io_uring(bool enable)
+{
+    return ((CDataChannel *)_data_channel)->enable_io_uring(enable);
+}
+
 bool CTcpClient::is_connect_established() const 
 { 
     return CONNECT_ESTABLISHED == _connect_state; 
@@ -206,8 +281,11 @@ bool CTcpClient::async_connect()
     {
         if (errno != EINPROGRESS)    
         {
+            int errcode = errno;
+            if (fd != -1)
+                close_fd(fd);
             on_connect_failure(); // 连接失败
-            THROW_SYSCALL_EXCEPTION(NULL, errno, "connect");
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "connect");
         }
     }
     
@@ -229,6 +307,8 @@ bool CTcpClient::async_connect()
 void CTcpClient::timed_connect()
 {                 	
     int fd = -1;
+    // 在CDeadlineScope中时不超过本线程当前的截止时间
+    const uint32_t milliseconds = sys::CDeadline::get_current().clamp_milliseconds(_milli_seconds);
     atomic_inc(&_reconnect_times); // 重连接次数增1，如果连接成功则减1
     
     do
@@ -236,16 +316,16 @@ void CTcpClient::timed_connect()
 	    try
 	    {
             // 超时连接需要先设置为非阻塞
-            bool nonblock = _milli_seconds > 0;                   
+            bool nonblock = milliseconds > 0;                   
             if (do_connect(fd, nonblock))
                 break; // 一次性连接成功了
             
             // 连接出错，不能继续
-            if ((0 == _milli_seconds) || (errno != EINPROGRESS))
+            if ((0 == milliseconds) || (errno != EINPROGRESS))
                 THROW_SYSCALL_EXCEPTION(NULL, errno, "connect");
 
             // 异步连接中，使用poll超时探测
-            if (!CUtils::timed_poll(fd, POLLIN | POLLOUT | POLLERR, _milli_seconds))
+            if (!CUtils::timed_poll(fd, POLLIN | POLLOUT | POLLERR, milliseconds))
                 THROW_SYSCALL_EXCEPTION(NULL, ETIMEDOUT, "poll");
 
 		    int errcode = 0;
@@ -255,7 +335,7 @@ void CTcpClient::timed_connect()
 		    if (errcode != 0)
 		        THROW_SYSCALL_EXCEPTION(NULL, errcode, "connect");
 
-            // 能够走到这里，肯定是_milli_seconds > 0
+            // 能够走到这里，肯定是milliseconds > 0
             net::set_nonblock(fd, false);
 	    }
 	    catch (sys::CSyscallException& ex)
@@ -274,6 +354,133 @@ void CTcpClient::timed_connect()
     after_connect();
 }
 
+void CTcpClient::race_connect(const std::vector<ip_node_t>& candidates, uint32_t stagger_milliseconds)
+{
+    if (candidates.empty())
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, "connect");
+
+    std::vector<struct pollfd> fds;
+    std::vector<size_t> indexes;     // fds中各连接对应的candidates下标
+    size_t next = 0;                 // 下一个待尝试的候选地址
+    int winner = -1;                 // 最先连接成功的在fds中的下标
+    int errcode = ETIMEDOUT;         // 全部失败时，最后一个失败原因
+    const uint64_t start_time = sys::CClock::get_milliseconds();
+    uint64_t next_time = start_time; // 下一个尝试的启动时间
+    atomic_inc(&_reconnect_times); // 重连接次数增1，如果连接成功则减1
+
+    while (-1 == winner)
+    {
+        uint64_t now = sys::CClock::get_milliseconds();
+        if ((_milli_seconds > 0) && (now >= start_time + _milli_seconds))
+        {
+            errcode = ETIMEDOUT;
+            break;
+        }
+
+        // 上一个尝试在错开的时长内未成功，或已失败，启动下一个
+        if ((next < candidates.size()) && (now >= next_time))
+        {
+            int fd = -1;
+            const size_t index = next++;
+            next_time = now + stagger_milliseconds;
+            try
+            {
+                const bool connected = connect_to(candidates[index].ip, candidates[index].port, true, false, _bind_local? &_local_ip: NULL, fd);
+                if (connected || (EINPROGRESS == errno))
+                {
+                    struct pollfd pfd = { fd, POLLOUT, 0 };
+                    fds.push_back(pfd);
+                    indexes.push_back(index);
+                    if (connected)
+                        winner = static_cast<int>(fds.size() - 1);
+                }
+                else
+                {
+                    errcode = errno;
+                    ::close(fd);
+                    next_time = now; // 立即失败的不用等待
+                }
+            }
+            catch (sys::CSyscallException& ex)
+            {
+                errcode = ex.errcode();
+                if (fd != -1)
+                    ::close(fd);
+                next_time = now;
+            }
+            continue;
+        }
+
+        // 所有候选地址都已失败
+        if (fds.empty() && (next >= candidates.size()))
+            break;
+
+        int milliseconds = -1;
+        if (next < candidates.size())
+            milliseconds = static_cast<int>(next_time - now);
+        if ((_milli_seconds > 0) && ((-1 == milliseconds) || (start_time + _milli_seconds - now < static_cast<uint64_t>(milliseconds))))
+            milliseconds = static_cast<int>(start_time + _milli_seconds - now);
+
+        int n = poll(fds.empty()? NULL: &fds[0], fds.size(), milliseconds);
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            errcode = errno;
+            break;
+        }
+
+        for (size_t i=fds.size(); i>0; --i)
+        {
+            if (0 == fds[i-1].revents)
+                continue;
+
+            int error = 0;
+            socklen_t error_length = sizeof(error);
+            if (-1 == getsockopt(fds[i-1].fd, SOL_SOCKET, SO_ERROR, &error, &error_length))
+                error = errno;
+            if ((0 == error) && (-1 == winner))
+            {
+                winner = static_cast<int>(i - 1);
+            }
+            else if (error != 0)
+            {
+                // 一个失败后立即启动下一个，不等错开的时长
+                errcode = error;
+                ::close(fds[i-1].fd);
+                fds.erase(fds.begin() + (i-1));
+                indexes.erase(indexes.begin() + (i-1));
+                if (winner > static_cast<int>(i-1))
+                    --winner;
+                next_time = sys::CClock::get_milliseconds();
+            }
+        }
+    }
+
+    // 关闭其它仍在进行中的连接
+    for (size_t i=0; i<fds.size(); ++i)
+    {
+        if (static_cast<int>(i) != winner)
+            ::close(fds[i].fd);
+    }
+    if (-1 == winner)
+    {
+        on_connect_failure(); // 连接失败
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "connect");
+    }
+
+    // 同timed_connect，连接成功后为阻塞的
+    const int fd = fds[winner].fd;
+    net::set_nonblock(fd, false);
+    _peer_ip = candidates[indexes[winner]].ip;
+    _peer_port = candidates[indexes[winner]].port;
+    set_fd(fd);
+    ((CDataChannel *)_data_channel)->attach(fd);
+	_connect_state = CONNECT_ESTABLISHED;
+    atomic_set(&_reconnect_times, 0); // 一旦连接成功，就将重连接次数清零
+    after_connect();
+}
+
 ssize_t CTcpClient::receive(char* buffer, size_t buffer_size) 
 { 
 	return ((CDataChannel *)_data_channel)->receive(buffer, buffer_size); 
@@ -294,16 +501,36 @@ ssize_t CTcpClient::timed_send(const char* buffer, size_t buffer_size, uint32_t
     return ((CDataChannel *)_data_channel)->timed_send(buffer, buffer_size, milliseconds); 
 }
 
+ssize_t CTcpClient::timed_receive(char* buffer, size_t buffer_size, const sys::CDeadline& deadline)
+{
+    return ((CDataChannel *)_data_channel)->timed_receive(buffer, buffer_size, deadline);
+}
+
+ssize_t CTcpClient::timed_send(const char* buffer, size_t buffer_size, const sys::CDeadline& deadline)
+{
+    return ((CDataChannel *)_data_channel)->timed_send(buffer, buffer_size, deadline);
+}
+
 bool CTcpClient::full_receive(char* buffer, size_t& buffer_size) 
 { 
 	return ((CDataChannel *)_data_channel)->full_receive(buffer, buffer_size); 
 }
 
+bool CTcpClient::full_receive(char* buffer, size_t& buffer_size, const sys::CDeadline& deadline)
+{
+    return ((CDataChannel *)_data_channel)->full_receive(buffer, buffer_size, deadline);
+}
+
 void CTcpClient::full_send(const char* buffer, size_t& buffer_size)
 { 
 	((CDataChannel *)_data_channel)->full_send(buffer, buffer_size); 
 }
 
+void CTcpClient::full_send(const char* buffer, size_t& buffer_size, const sys::CDeadline& deadline)
+{
+    ((CDataChannel *)_data_channel)->full_send(buffer, buffer_size, deadline);
+}
+
 ssize_t CTcpClient::send_file(int file_fd, off_t *offset, size_t count)
 {
     return ((CDataChannel *)_data_channel)->send_file(file_fd, offset, count); 
@@ -314,6 +541,11 @@ void CTcpClient::full_send_file(int file_fd, off_t *offset, size_t& count)
     ((CDataChannel *)_data_channel)->full_send_file(file_fd, offset, count); 
 }
 
+utils::handle_result_t CTcpClient::continue_send_file(int file_fd, off_t* offset, size_t& count, size_t chunk_size, uint32_t chunk_number)
+{
+    return ((CDataChannel *)_data_channel)->continue_send_file(file_fd, offset, count, chunk_size, chunk_number);
+}
+
 bool CTcpClient::full_map_tofile(int file_fd, size_t& size, size_t offset)
 {
     return ((CDataChannel *)_data_channel)->full_map_tofile(file_fd, size, offset); 
@@ -324,6 +556,25 @@ bool CTcpClient::full_write_tofile(int file_fd, size_t& size, size_t offset)
     return ((CDataChannel *)_data_channel)->full_write_tofile(file_fd, size, offset); 
 }
 
+bool CTcpClient::full_splice_tofile(int file_fd, size_t& size, size_t offset)
+{
+    return ((CDataChannel *)_data_channel)->full_splice_tofile(file_fd, size, offset);
+}
+
+bool CTcpClient::enable_ktls(bool is_tx, const void* crypto_info, socklen_t crypto_info_size)
+{
+#if defined(TCP_ULP) && __has_include(<linux/tls.h>)
+    // 同一连接第二次设置ULP（如先开启了TLS_TX）时返回EEXIST
+    if ((-1 == setsockopt(get_fd(), SOL_TCP, TCP_ULP, "tls", sizeof("tls"))) && (errno != EEXIST))
+        return false;
+
+    return 0 == setsockopt(get_fd(), SOL_TLS, is_tx? TLS_TX: TLS_RX, crypto_info, crypto_info_size);
+#else
+    errno = ENOPROTOOPT;
+    return false;
+#endif // TCP_ULP
+}
+
 ssize_t CTcpClient::readv(const struct iovec *iov, int iovcnt)
 {
     return ((CDataChannel *)_data_channel)->readv(iov, iovcnt);
@@ -334,4 +585,14 @@ ssize_t CTcpClient::writev(const struct iovec *iov, int iovcnt)
     return ((CDataChannel *)_data_channel)->writev(iov, iovcnt);
 }
 
+ssize_t CTcpClient::receive(CIoBuffer* buffer)
+{
+    return ((CDataChannel *)_data_channel)->receive(buffer);
+}
+
+ssize_t CTcpClient::send(CIoBuffer* buffer)
+{
+    return ((CDataChannel *)_data_channel)->send(buffer);
+}
+
 NET_NAMESPACE_END
@@ -0,0 +1,478 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/tcp_client_pool.h"
+#include "sys/log.h"
+#include <sys/socket.h>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+// 在事件循环中建立一个连接
+class CConnectTask: public ILoopTask
+{
+public:
+    CConnectTask(CTcpClientPool* client_pool, CTcpClientPool::Node* node)
+        : _client_pool(client_pool), _node(node)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _client_pool->start_connect(_node);
+    }
+
+private:
+    CTcpClientPool* _client_pool;
+    CTcpClientPool::Node* _node;
+};
+
+// 在事件循环中启动健康检查定时器
+class CPoolTimerTask: public ILoopTask
+{
+public:
+    CPoolTimerTask(CTcpClientPool* client_pool)
+        : _client_pool(client_pool)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _client_pool->start_timer();
+    }
+
+private:
+    CTcpClientPool* _client_pool;
+};
+
+// 在事件循环中销毁连接池
+class CPoolDestroyTask: public ILoopTask
+{
+public:
+    CPoolDestroyTask(CTcpClientPool* client_pool)
+        : _client_pool(client_pool)
+    {
+    }
+
+private:
+    virtual void execute(CEventLoop* event_loop)
+    {
+        _client_pool->do_destroy();
+    }
+
+private:
+    CTcpClientPool* _client_pool;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+CPooledTcpClient::CPooledTcpClient()
+    : _client_pool(NULL)
+    , _node(NULL)
+    , _connect_time(0)
+{
+    // 连接池持有一个引用，事件循环剔除时不会因引用计数为0而delete池中的对象
+    inc_refcount();
+}
+
+void CPooledTcpClient::reset()
+{
+    close();
+    _client_pool = NULL;
+    _node = NULL;
+    _connect_time = 0;
+}
+
+epoll_event_t CPooledTcpClient::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    CEventLoop* event_loop = static_cast<CEventLoop*>(input_ptr);
+    const bool success = (0 == (events & (EPOLLERR | EPOLLHUP))) && (0 == get_socket_error_code());
+
+    // 先从事件循环剔除，再交给连接池，之后连接可能立即被其它线程借走
+    event_loop->remove(this, false);
+    if (success)
+        set_connected_state();
+    _client_pool->on_connect_result(this, success);
+    return epoll_none;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CTcpClientPool::CTcpClientPool(CEventLoop* event_loop, uint32_t min_idle, uint32_t max_idle, uint32_t max_connections)
+    : _event_loop(event_loop)
+    , _min_idle(min_idle)
+    , _max_idle((max_idle < min_idle)? min_idle: max_idle)
+    , _max_connections((max_connections < _max_idle)? _max_idle: max_connections)
+    , _connect_timeout(3000)
+    , _check_interval(1000)
+    , _timer_id(0)
+    , _destroyed(false)
+    , _object_pool(true)
+    , _connect_number(0)
+    , _connect_failure_number(0)
+    , _reuse_number(0)
+    , _evict_number(0)
+{
+}
+
+CTcpClientPool::~CTcpClientPool()
+{
+    for (node_table_t::iterator iter=_node_table.begin(); iter!=_node_table.end(); ++iter)
+    {
+        Node* node = iter->second;
+        while (!node->idle_clients.empty())
+        {
+            release_client(node->idle_clients.front());
+            node->idle_clients.pop_front();
+        }
+        delete node;
+    }
+    _node_table.clear();
+    _object_pool.destroy();
+}
+
+void CTcpClientPool::create(uint32_t object_number, uint32_t check_interval)
+{
+    _check_interval = (0 == check_interval)? 1000: check_interval;
+    _object_pool.create(object_number);
+    _event_loop->post(new CPoolTimerTask(this));
+}
+
+void CTcpClientPool::destroy()
+{
+    if (_event_loop->in_loop_thread())
+    {
+        do_destroy();
+    }
+    else
+    {
+        _event_loop->post(new CPoolDestroyTask(this));
+
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        while (!_destroyed)
+            _event.wait(_lock);
+    }
+}
+
+void CTcpClientPool::add_node(const ip_node_t& ip_node)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    (void)get_node(ip_node);
+}
+
+CTcpClient* CTcpClientPool::borrow(const ip_node_t& ip_node, uint32_t milliseconds)
+{
+    const bool can_wait = (milliseconds > 0) && !_event_loop->in_loop_thread();
+    const uint64_t deadline = CEventLoop::get_monotonic_milliseconds() + milliseconds;
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    Node* node = get_node(ip_node);
+
+    for (;;)
+    {
+        if (_destroyed)
+            return NULL;
+
+        if (!node->idle_clients.empty())
+        {
+            CPooledTcpClient* client = node->idle_clients.front();
+            node->idle_clients.pop_front();
+            ++node->busy_number;
+            ++_reuse_number;
+            return client;
+        }
+
+        // 每个等待者对应一个正在建立的连接
+        const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+        if ((node->connecting_number <= node->waiting_number)
+         && (get_connection_number(node) < _max_connections)
+         && (now >= node->retry_time))
+            post_connect(node, 1);
+
+        if (!can_wait || (now >= deadline))
+            return NULL;
+
+        ++node->waiting_number;
+        (void)_event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+        --node->waiting_number;
+    }
+}
+
+void CTcpClientPool::pay_back(CTcpClient* client, bool broken)
+{
+    CPooledTcpClient* pooled_client = static_cast<CPooledTcpClient*>(client);
+    Node* node = static_cast<Node*>(pooled_client->_node);
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    --node->busy_number;
+    if (!broken && !_destroyed && (pooled_client->get_fd() != -1)
+     && ((node->idle_clients.size() < _max_idle) || (node->waiting_number > 0)))
+    {
+        node->idle_clients.push_front(pooled_client);
+        if (node->waiting_number > 0)
+            _event.broadcast();
+    }
+    else
+    {
+        release_client(pooled_client);
+    }
+}
+
+uint32_t CTcpClientPool::get_idle_number(const ip_node_t& ip_node) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    const Node* node = find_node(ip_node);
+    return (NULL == node)? 0: static_cast<uint32_t>(node->idle_clients.size());
+}
+
+uint32_t CTcpClientPool::get_connection_number(const ip_node_t& ip_node) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    const Node* node = find_node(ip_node);
+    return (NULL == node)? 0: get_connection_number(node);
+}
+
+// 以下均须在持有_lock时调用
+CTcpClientPool::Node* CTcpClientPool::get_node(const ip_node_t& ip_node)
+{
+    node_table_t::iterator iter = _node_table.find(ip_node);
+    if (iter != _node_table.end())
+        return iter->second;
+
+    Node* node = new Node;
+    node->ip_node = ip_node;
+    node->connecting_number = 0;
+    node->busy_number = 0;
+    node->waiting_number = 0;
+    node->failure_number = 0;
+    node->retry_time = 0;
+    _node_table.insert(std::make_pair(ip_node, node));
+
+    if (!_destroyed)
+        post_connect(node, (_min_idle < _max_connections)? _min_idle: _max_connections);
+    return node;
+}
+
+const CTcpClientPool::Node* CTcpClientPool::find_node(const ip_node_t& ip_node) const
+{
+    node_table_t::const_iterator iter = _node_table.find(ip_node);
+    return (iter == _node_table.end())? NULL: iter->second;
+}
+
+uint32_t CTcpClientPool::get_connection_number(const Node* node) const
+{
+    return static_cast<uint32_t>(node->idle_clients.size()) + node->connecting_number + node->busy_number;
+}
+
+void CTcpClientPool::post_connect(Node* node, uint32_t number)
+{
+    for (uint32_t i=0; i<number; ++i)
+    {
+        ++node->connecting_number;
+        _event_loop->post(new CConnectTask(this, node));
+    }
+}
+
+void CTcpClientPool::release_client(CPooledTcpClient* client)
+{
+    // reset中会关闭连接
+    _object_pool.pay_back(client);
+}
+
+// 以下在事件循环线程中执行
+void CTcpClientPool::start_connect(Node* node)
+{
+    CPooledTcpClient* client;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_destroyed)
+        {
+            --node->connecting_number;
+            return;
+        }
+
+        client = _object_pool.borrow();
+        client->_client_pool = this;
+        client->_node = node;
+        client->_connect_time = CEventLoop::get_monotonic_milliseconds();
+        client->set_peer(node->ip_node);
+        node->connecting_clients.insert(client);
+    }
+
+    try
+    {
+        if (client->async_connect())
+            on_connect_result(client, true);
+        else
+            _event_loop->add(client, EPOLLOUT);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        MYLOG_DEBUG("connect %s error: %s\n", client->to_string().c_str(), ex.str().c_str());
+        on_connect_result(client, false);
+    }
+}
+
+void CTcpClientPool::on_connect_result(CPooledTcpClient* client, bool success)
+{
+    Node* node = static_cast<Node*>(client->_node);
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    --node->connecting_number;
+    node->connecting_clients.erase(client);
+    if (!success)
+    {
+        // 按失败次数退避，避免对不可用的节点频繁地重连
+        const uint32_t shift = (node->failure_number < 10)? node->failure_number: 10;
+        const uint64_t retry_milliseconds = static_cast<uint64_t>(_check_interval) << shift;
+        node->retry_time = CEventLoop::get_monotonic_milliseconds()
+            + ((retry_milliseconds < MAX_RETRY_MILLISECONDS)? retry_milliseconds: MAX_RETRY_MILLISECONDS);
+        ++node->failure_number;
+        ++_connect_failure_number;
+        release_client(client);
+    }
+    else
+    {
+        node->failure_number = 0;
+        node->retry_time = 0;
+        ++_connect_number;
+        if (_destroyed || ((node->idle_clients.size() >= _max_idle) && (0 == node->waiting_number)))
+        {
+            release_client(client);
+        }
+        else
+        {
+            node->idle_clients.push_front(client);
+            if (node->waiting_number > 0)
+                _event.broadcast();
+        }
+    }
+}
+
+void CTcpClientPool::start_timer()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    if (!_destroyed && (0 == _timer_id))
+        _timer_id = _event_loop->run_after(_check_interval, this);
+}
+
+uint32_t CTcpClientPool::on_timer(CEventLoop* event_loop, uint64_t timer_id)
+{
+    const uint64_t now = CEventLoop::get_monotonic_milliseconds();
+    std::vector<CPooledTcpClient*> timeout_clients;
+    std::vector<std::pair<Node*, uint32_t> > connect_nodes;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+        for (node_table_t::iterator iter=_node_table.begin(); iter!=_node_table.end(); ++iter)
+        {
+            Node* node = iter->second;
+
+            // 空闲连接上不应有数据可读，可读说明对端已关闭或出错
+            for (std::list<CPooledTcpClient*>::iterator client_iter=node->idle_clients.begin(); client_iter!=node->idle_clients.end();)
+            {
+                CPooledTcpClient* client = *client_iter;
+                char byte;
+                const ssize_t bytes = recv(client->get_fd(), &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+
+                if ((-1 == bytes) && ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno)))
+                {
+                    ++client_iter;
+                }
+                else
+                {
+                    client_iter = node->idle_clients.erase(client_iter);
+                    ++_evict_number;
+                    release_client(client);
+                }
+            }
+
+            for (std::set<CPooledTcpClient*>::iterator client_iter=node->connecting_clients.begin(); client_iter!=node->connecting_clients.end(); ++client_iter)
+            {
+                CPooledTcpClient* client = *client_iter;
+                if (client->_connect_time + _connect_timeout <= now)
+                    timeout_clients.push_back(client);
+            }
+
+            // 补足空闲连接，正在连接的也计算在内
+            const uint32_t available = static_cast<uint32_t>(node->idle_clients.size()) + node->connecting_number;
+            const uint32_t connection_number = get_connection_number(node);
+            if ((available < _min_idle) && (connection_number < _max_connections) && (now >= node->retry_time))
+            {
+                uint32_t number = _min_idle - available;
+                if (number > _max_connections - connection_number)
+                    number = _max_connections - connection_number;
+                node->connecting_number += number;
+                connect_nodes.push_back(std::make_pair(node, number));
+            }
+        }
+    }
+
+    // 超时未连上的，从事件循环剔除后再释放
+    for (std::vector<CPooledTcpClient*>::size_type i=0; i<timeout_clients.size(); ++i)
+    {
+        event_loop->remove(timeout_clients[i], false);
+        on_connect_result(timeout_clients[i], false);
+    }
+    for (std::vector<std::pair<Node*, uint32_t> >::size_type i=0; i<connect_nodes.size(); ++i)
+    {
+        for (uint32_t j=0; j<connect_nodes[i].second; ++j)
+            start_connect(connect_nodes[i].first);
+    }
+
+    return _check_interval;
+}
+
+void CTcpClientPool::do_destroy()
+{
+    std::vector<CPooledTcpClient*> connecting_clients;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_destroyed)
+            return;
+        _destroyed = true;
+
+        for (node_table_t::iterator iter=_node_table.begin(); iter!=_node_table.end(); ++iter)
+        {
+            Node* node = iter->second;
+            while (!node->idle_clients.empty())
+            {
+                release_client(node->idle_clients.front());
+                node->idle_clients.pop_front();
+            }
+
+            connecting_clients.insert(connecting_clients.end(), node->connecting_clients.begin(), node->connecting_clients.end());
+        }
+    }
+
+    if (_timer_id != 0)
+    {
+        (void)_event_loop->cancel_timer(_timer_id);
+        _timer_id = 0;
+    }
+    for (std::vector<CPooledTcpClient*>::size_type i=0; i<connecting_clients.size(); ++i)
+    {
+        _event_loop->remove(connecting_clients[i], false);
+        on_connect_result(connecting_clients[i], false);
+    }
+
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _event.broadcast();
+}
+
+NET_NAMESPACE_END
@@ -129,4 +129,14 @@ ssize_t CTcpWaiter::writev(const struct iovec *iov, int iovcnt)
     return ((CDataChannel *)_data_channel)->writev(iov, iovcnt);
 }
 
+ssize_t CTcpWaiter::receive(CIoBuffer* buffer)
+{
+    return ((CDataChannel *)_data_channel)->receive(buffer);
+}
+
+ssize_t CTcpWaiter::send(CIoBuffer* buffer)
+{
+    return ((CDataChannel *)_data_channel)->send(buffer);
+}
+
 NET_NAMESPACE_END
@@ -18,9 +18,134 @@
  */
 #include "mooon/net/udp_socket.h"
 #include "mooon/net/utils.h"
+#include <netinet/udp.h>
 #include <unistd.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
 NET_NAMESPACE_BEGIN
 
+// 每个槽位的控制信息区大小，用于接收UDP_GRO的分段大小和SO_TIMESTAMPING的时间戳（软件、已废弃和硬件三个）
+#define UDP_CONTROL_SIZE (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec) * 3))
+
+int64_t get_timestamp_latency_nanoseconds(const struct timespec& timestamp)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec - timestamp.tv_sec) * 1000000000 + (now.tv_nsec - timestamp.tv_nsec);
+}
+
+// 从控制信息中找出SCM_TIMESTAMPING，第一个为软件时间戳，第三个为硬件时间戳
+static bool find_timestamp(const struct msghdr* msg_hdr, struct timespec* timestamp)
+{
+    if ((NULL == msg_hdr->msg_control) || (msg_hdr->msg_controllen < sizeof(struct cmsghdr)))
+        return false;
+
+    for (struct cmsghdr* cmsg=CMSG_FIRSTHDR(msg_hdr); cmsg!=NULL; cmsg=CMSG_NXTHDR(const_cast<struct msghdr*>(msg_hdr), cmsg))
+    {
+        if ((SOL_SOCKET == cmsg->cmsg_level) && (SO_TIMESTAMPING == cmsg->cmsg_type))
+        {
+            struct timespec timestamps[3];
+            memcpy(timestamps, CMSG_DATA(cmsg), sizeof(timestamps));
+            *timestamp = ((timestamps[2].tv_sec != 0) || (timestamps[2].tv_nsec != 0))? timestamps[2]: timestamps[0];
+            return (timestamp->tv_sec != 0) || (timestamp->tv_nsec != 0);
+        }
+    }
+
+    return false;
+}
+
+CUdpMessageArena::CUdpMessageArena(uint32_t message_number, uint32_t message_size)
+    :_message_number((0 == message_number)? 1: message_number)
+    ,_message_size((0 == message_size)? 1: message_size)
+    ,_number(0)
+{
+    _buffer = new char[static_cast<size_t>(_message_number) * _message_size];
+    _control_buffer = new char[_message_number * UDP_CONTROL_SIZE];
+    _mmsghdrs = new struct mmsghdr[_message_number];
+    _iovecs = new struct iovec[_message_number];
+    _addrs = new struct sockaddr_in[_message_number];
+
+    memset(_mmsghdrs, 0, sizeof(struct mmsghdr) * _message_number);
+    for (uint32_t i=0; i<_message_number; ++i)
+    {
+        _mmsghdrs[i].msg_hdr.msg_iov = &_iovecs[i];
+        _mmsghdrs[i].msg_hdr.msg_iovlen = 1;
+        _mmsghdrs[i].msg_hdr.msg_name = &_addrs[i];
+        _iovecs[i].iov_base = get_data(i);
+        _iovecs[i].iov_len = 0;
+    }
+}
+
+CUdpMessageArena::~CUdpMessageArena()
+{
+    delete []_addrs;
+    delete []_iovecs;
+    delete []_mmsghdrs;
+    delete []_control_buffer;
+    delete []_buffer;
+}
+
+bool CUdpMessageArena::add(const void* data, size_t data_size, const struct sockaddr_in& to_addr)
+{
+    if ((_number >= _message_number) || (data_size > _message_size))
+        return false;
+
+    struct msghdr* msg_hdr = &_mmsghdrs[_number].msg_hdr;
+    memcpy(get_data(_number), data, data_size);
+    _iovecs[_number].iov_len = data_size;
+    _addrs[_number] = to_addr;
+    msg_hdr->msg_namelen = sizeof(struct sockaddr_in);
+    msg_hdr->msg_control = NULL;
+    msg_hdr->msg_controllen = 0;
+    msg_hdr->msg_flags = 0;
+    ++_number;
+    return true;
+}
+
+uint16_t CUdpMessageArena::get_segment_size(uint32_t index) const
+{
+    const struct msghdr* msg_hdr = &_mmsghdrs[index].msg_hdr;
+    if (NULL == msg_hdr->msg_control)
+        return 0;
+
+    for (struct cmsghdr* cmsg=CMSG_FIRSTHDR(msg_hdr); cmsg!=NULL; cmsg=CMSG_NXTHDR(const_cast<struct msghdr*>(msg_hdr), cmsg))
+    {
+        if ((SOL_UDP == cmsg->cmsg_level) && (UDP_GRO == cmsg->cmsg_type))
+        {
+            int segment_size;
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            return static_cast<uint16_t>(segment_size);
+        }
+    }
+
+    return 0;
+}
+
+bool CUdpMessageArena::get_timestamp(uint32_t index, struct timespec* timestamp) const
+{
+    return find_timestamp(&_mmsghdrs[index].msg_hdr, timestamp);
+}
+
+void CUdpMessageArena::prepare_receive()
+{
+    _number = 0;
+    for (uint32_t i=0; i<_message_number; ++i)
+    {
+        struct msghdr* msg_hdr = &_mmsghdrs[i].msg_hdr;
+        _iovecs[i].iov_len = _message_size;
+        msg_hdr->msg_namelen = sizeof(struct sockaddr_in);
+        msg_hdr->msg_control = _control_buffer + i*UDP_CONTROL_SIZE;
+        msg_hdr->msg_controllen = UDP_CONTROL_SIZE;
+        msg_hdr->msg_flags = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 CUdpSocket::CUdpSocket()
 {
     int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
@@ -126,6 +251,37 @@ int CUdpSocket::receive_from(void* buffer, size_t buffer_size, struct sockaddr_i
     return bytes;
 }
 
+int CUdpSocket::receive_from(void* buffer, size_t buffer_size, struct sockaddr_in* from_addr, struct timespec* timestamp)
+{
+    char control[CMSG_SPACE(sizeof(struct timespec) * 3)];
+    struct iovec iov;
+    struct msghdr msg_hdr;
+
+    iov.iov_base = buffer;
+    iov.iov_len = buffer_size;
+    memset(&msg_hdr, 0, sizeof(msg_hdr));
+    msg_hdr.msg_name = from_addr;
+    msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    msg_hdr.msg_iov = &iov;
+    msg_hdr.msg_iovlen = 1;
+    msg_hdr.msg_control = control;
+    msg_hdr.msg_controllen = sizeof(control);
+
+    int bytes = ::recvmsg(get_fd(), &msg_hdr, 0);
+    if (-1 == bytes)
+    {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "recvmsg");
+    }
+    else if (!find_timestamp(&msg_hdr, timestamp))
+    {
+        timestamp->tv_sec = 0;
+        timestamp->tv_nsec = 0;
+    }
+
+    return bytes;
+}
+
 // UDP无应用层发送缓存区，数据直接进入网卡输出队列，如果网卡输出队列已满，则设置errno值为ENOBUFS，
 // 但根据man 2 sendto说明，一般情况下，Linux不会出现ENOBUFS，一旦网卡输出队列满则直接丢弃数据。
 int CUdpSocket::timed_receive_from(void* buffer, size_t buffer_size, uint32_t* from_ip, uint16_t* from_port, uint32_t milliseconds)
@@ -144,4 +300,84 @@ int CUdpSocket::timed_receive_from(void* buffer, size_t buffer_size, struct sock
     return receive_from(buffer, buffer_size, from_addr);
 }
 
+int CUdpSocket::receive_batch(CUdpMessageArena* arena)
+{
+    arena->prepare_receive();
+
+    int number = recvmmsg(get_fd(), arena->_mmsghdrs, arena->_message_number, MSG_WAITFORONE, NULL);
+    if (-1 == number)
+    {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "recvmmsg");
+        return -1;
+    }
+
+    for (int i=0; i<number; ++i)
+        arena->_iovecs[i].iov_len = arena->_mmsghdrs[i].msg_len;
+    arena->_number = static_cast<uint32_t>(number);
+    return number;
+}
+
+int CUdpSocket::timed_receive_batch(CUdpMessageArena* arena, uint32_t milliseconds)
+{
+    if (!CUtils::timed_poll(get_fd(), POLLIN, milliseconds))
+        THROW_SYSCALL_EXCEPTION("receive timeout", ETIMEDOUT, "pool");
+
+    return receive_batch(arena);
+}
+
+int CUdpSocket::send_batch(CUdpMessageArena* arena, uint32_t offset)
+{
+    if (offset >= arena->_number)
+        return 0;
+
+    int number = sendmmsg(get_fd(), arena->_mmsghdrs+offset, arena->_number-offset, 0);
+    if (-1 == number)
+    {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmmsg");
+    }
+
+    return number;
+}
+
+int CUdpSocket::send_gso(const void* buffer, size_t buffer_size, uint16_t segment_size, const struct sockaddr_in& to_addr)
+{
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    struct iovec iov;
+    struct msghdr msg_hdr;
+
+    memset(control, 0, sizeof(control));
+    memset(&msg_hdr, 0, sizeof(msg_hdr));
+    iov.iov_base = const_cast<void*>(buffer);
+    iov.iov_len = buffer_size;
+    msg_hdr.msg_name = const_cast<struct sockaddr_in*>(&to_addr);
+    msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    msg_hdr.msg_iov = &iov;
+    msg_hdr.msg_iovlen = 1;
+    msg_hdr.msg_control = control;
+    msg_hdr.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg_hdr);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+    int bytes = ::sendmsg(get_fd(), &msg_hdr, 0);
+    if (-1 == bytes)
+    {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmsg");
+    }
+
+    return bytes;
+}
+
+bool CUdpSocket::enable_gro(bool enable)
+{
+    int value = enable? 1: 0;
+    return 0 == ::setsockopt(get_fd(), SOL_UDP, UDP_GRO, &value, sizeof(value));
+}
+
 NET_NAMESPACE_END
@@ -24,7 +24,9 @@
 #include <net/if_arp.h>
 #include <sys/socket.h>
 #include "net/utils.h"
+#include "net/dns_resolver.h"
 #include "sys/close_helper.h"
+#include "sys/fiber.h"
 #include "sys/syscall_exception.h"
 #include "utils/string_utils.h"
 NET_NAMESPACE_BEGIN
@@ -97,10 +99,9 @@ bool CUtils::is_valid_ipv4(const char* str)
 }
 
 bool CUtils::is_valid_ipv6(const char* str)
-{    
-    const char* colon = strchr(str, ':');
-    if (NULL == colon) return false;
-    return strchr(colon, ':') != NULL;
+{
+    uint32_t ipv6[4];
+    return string_toipv6(str, ipv6);
 }
 
 bool CUtils::get_ip_address(const char* hostname, string_ip_array_t& ip_array, std::string& errinfo)
@@ -147,6 +148,17 @@ bool CUtils::get_ip_address(const char* hostname, string_ip_array_t& ip_array, s
     return ip_array.size() > 0;
 }
 
+bool CUtils::resolve_ip_address(const char* hostname, string_ip_array_t& ip_array, std::string& errinfo, uint32_t milliseconds)
+{
+    ip_address_array_t address_array;
+    if (!CDnsResolver::get_default()->resolve(hostname, &address_array, &errinfo, milliseconds))
+        return false;
+
+    for (ip_address_array_t::size_type i=0; i<address_array.size(); ++i)
+        ip_array.push_back(address_array[i].to_string());
+    return true;
+}
+
 //#include <net/if.h>
 /* Structure used in SIOCGIFCONF request.  Used to retrieve interface
 configuration for machine (useful for programs which must know all
@@ -303,16 +315,163 @@ std::string CUtils::ipv6_tostring(const uint32_t* ipv6)
     return ip_address;
 }
 
+// 解析点分十进制的IPV4地址，结果为网络字节序的4个字节，
+// 同inet_pton：必须为4段，每段不超过255，除单个0外不能以0开头
+static bool parse_ipv4(const char* str, const char* end, uint8_t* ipv4)
+{
+    for (int i=0; i<4; ++i)
+    {
+        if ((str == end) || (static_cast<unsigned char>(*str - '0') > 9))
+            return false;
+
+        unsigned int octet = static_cast<unsigned char>(*str++ - '0');
+        if ((str < end) && (static_cast<unsigned char>(*str - '0') <= 9))
+        {
+            if (0 == octet)
+                return false;
+            octet = octet * 10 + static_cast<unsigned char>(*str++ - '0');
+            if ((str < end) && (static_cast<unsigned char>(*str - '0') <= 9))
+            {
+                octet = octet * 10 + static_cast<unsigned char>(*str++ - '0');
+                if (octet > 255)
+                    return false;
+            }
+        }
+
+        ipv4[i] = static_cast<uint8_t>(octet);
+        if (i < 3)
+        {
+            if ((str == end) || (*str != '.'))
+                return false;
+            ++str;
+        }
+    }
+
+    return str == end;
+}
+
+static inline int hex_value(char c)
+{
+    if (static_cast<unsigned char>(c - '0') <= 9)
+        return c - '0';
+    c |= 0x20; // 转成小写
+    if (static_cast<unsigned char>(c - 'a') <= 5)
+        return c - 'a' + 10;
+    return -1;
+}
+
+// 解析IPV6地址，结果为网络字节序的16个字节，算法同BIND和glibc的inet_pton6：
+// 每段1到4个十六进制数字，“::”最多出现一次且不能用在已满8段时，最后32位可为点分十进制的IPV4地址
+static bool parse_ipv6(const char* str, const char* end, uint8_t* ipv6)
+{
+    uint8_t bytes[16];
+    uint8_t* tp = bytes;
+    uint8_t* const endp = bytes + sizeof(bytes);
+    uint8_t* colonp = NULL;
+    const char* token;
+    unsigned int value = 0;
+    int digits = 0;
+
+    // 开头的冒号只能是“::”的一部分
+    if ((str < end) && (':' == *str))
+    {
+        if ((++str == end) || (*str != ':'))
+            return false;
+    }
+
+    token = str;
+    while (str < end)
+    {
+        const char c = *str++;
+        const int d = hex_value(c);
+        if (d >= 0)
+        {
+            if (++digits > 4)
+                return false;
+            value = (value << 4) | d;
+            continue;
+        }
+
+        if (':' == c)
+        {
+            token = str;
+            if (0 == digits)
+            {
+                if (colonp != NULL)
+                    return false;
+                colonp = tp;
+                continue;
+            }
+            if ((str == end) || (tp + 2 > endp))
+                return false;
+
+            *tp++ = static_cast<uint8_t>(value >> 8);
+            *tp++ = static_cast<uint8_t>(value);
+            value = 0;
+            digits = 0;
+            continue;
+        }
+
+        if (('.' == c) && (tp + 4 <= endp) && parse_ipv4(token, end, tp))
+        {
+            tp += 4;
+            digits = 0;
+            break;
+        }
+        return false;
+    }
+
+    if (digits > 0)
+    {
+        if (tp + 2 > endp)
+            return false;
+        *tp++ = static_cast<uint8_t>(value >> 8);
+        *tp++ = static_cast<uint8_t>(value);
+    }
+    if (colonp != NULL)
+    {
+        // “::”至少代表一段0，将其后的段移到末尾
+        if (tp == endp)
+            return false;
+
+        const size_t n = tp - colonp;
+        memmove(endp - n, colonp, n);
+        memset(colonp, 0, endp - n - colonp);
+        tp = endp;
+    }
+    if (tp != endp)
+        return false;
+
+    memcpy(ipv6, bytes, sizeof(bytes));
+    return true;
+}
+
 bool CUtils::string_toipv4(const char* source, uint32_t& ipv4)
 {    
     if (NULL == source) return false;
-    return inet_pton(AF_INET, source, (void*)&ipv4) > 0;
+    return string_toipv4(source, strlen(source), ipv4);
 }
 
 bool CUtils::string_toipv6(const char* source, uint32_t* ipv6)
 {       
     if ((NULL == source) || (NULL == ipv6)) return false;
-    return inet_pton(AF_INET6, source, (void*)ipv6) > 0;
+    return string_toipv6(source, strlen(source), ipv6);
+}
+
+bool CUtils::string_toipv4(const char* source, size_t size, uint32_t& ipv4)
+{
+    uint8_t bytes[4];
+    if ((NULL == source) || !parse_ipv4(source, source+size, bytes))
+        return false;
+
+    memcpy(&ipv4, bytes, sizeof(bytes));
+    return true;
+}
+
+bool CUtils::string_toipv6(const char* source, size_t size, uint32_t* ipv6)
+{
+    if ((NULL == source) || (NULL == ipv6)) return false;
+    return parse_ipv6(source, source+size, reinterpret_cast<uint8_t*>(ipv6));
 }
 
 bool CUtils::is_ethx(const char* str)
@@ -333,6 +492,10 @@ bool CUtils::is_broadcast_address(const char* str)
 
 bool CUtils::timed_poll(int fd, int events_requested, int milliseconds, int* events_returned)
 {
+    // 纤程中只挂起纤程，不阻塞载体线程
+    if (sys::CFiberScheduler::in_fiber())
+        return sys::CFiberScheduler::poll(fd, events_requested, milliseconds, events_returned);
+
     int remaining_milliseconds = milliseconds;
     struct pollfd fds[1];
     fds[0].fd = fd;
@@ -0,0 +1,101 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/write_coalescer.h"
+#include "net/event_loop.h"
+#include <sys/socket.h>
+NET_NAMESPACE_BEGIN
+
+CWriteCoalescer::CWriteCoalescer(CEpollable* epollable, CEventLoop* event_loop, coalesce_policy_t policy)
+    : _epollable(epollable)
+    , _event_loop(event_loop)
+    , _policy(policy)
+    , _low_latency(false)
+    , _batching(false)
+    , _flush_pending(false)
+    , _flush_number(0)
+{
+}
+
+CWriteCoalescer::~CWriteCoalescer()
+{
+    flush();
+}
+
+void CWriteCoalescer::set_policy(coalesce_policy_t policy)
+{
+    flush();
+    _policy = policy;
+}
+
+void CWriteCoalescer::set_event_loop(CEventLoop* event_loop)
+{
+    flush();
+    _event_loop = event_loop;
+}
+
+void CWriteCoalescer::set_low_latency(bool low_latency)
+{
+    if (low_latency)
+        flush();
+    _low_latency = low_latency;
+}
+
+void CWriteCoalescer::begin()
+{
+    if (_low_latency || (coalesce_none == _policy))
+        return;
+
+    if (!_batching)
+    {
+        if (coalesce_cork == _policy)
+            set_tcp_option(_epollable->get_fd(), true, TCP_CORK);
+        _batching = true;
+    }
+    if ((_event_loop != NULL) && !_flush_pending)
+    {
+        _event_loop->flush_later(this);
+        _flush_pending = true;
+    }
+}
+
+int CWriteCoalescer::get_send_flags() const
+{
+    return (_batching && (coalesce_more == _policy))? MSG_MORE: 0;
+}
+
+void CWriteCoalescer::flush()
+{
+    if (_flush_pending)
+    {
+        _event_loop->cancel_flush(this);
+        _flush_pending = false;
+    }
+    if (!_batching)
+        return;
+
+    // 去掉TCP_CORK或设置TCP_NODELAY都会立即推出攒着的数据
+    const int option = (coalesce_cork == _policy)? TCP_CORK: TCP_NODELAY;
+    const int on = (coalesce_cork == _policy)? 0: 1;
+    (void)setsockopt(_epollable->get_fd(), SOL_TCP, option, &on, sizeof(on));
+
+    _batching = false;
+    ++_flush_number;
+}
+
+NET_NAMESPACE_END
@@ -0,0 +1,498 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/xdp_socket.h"
+#include "sys/log.h"
+#include <errno.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_bpf) && __has_include(<linux/if_xdp.h>) && __has_include(<linux/bpf.h>)
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#define HAVE_AF_XDP 1
+#endif
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+NET_NAMESPACE_BEGIN
+
+// 以太网、IPv4（无选项）和UDP首部的字节数
+#define ETH_HEADER_SIZE  14
+#define IPV4_HEADER_SIZE 20
+#define UDP_HEADER_SIZE  8
+
+// bind遇到EBUSY时的重试次数，每次间隔100毫秒
+#define XDP_BIND_RETRIES 20
+
+#if HAVE_AF_XDP
+static int bpf(int cmd, union bpf_attr* attr)
+{
+    return static_cast<int>(syscall(__NR_bpf, cmd, attr, sizeof(*attr)));
+}
+
+// 和内核头文件中的BPF_*宏相同，用于手工组装XDP程序
+static struct bpf_insn make_insn(uint8_t code, uint8_t dst_reg, uint8_t src_reg, int16_t off, int32_t imm)
+{
+    struct bpf_insn insn;
+    insn.code = code;
+    insn.dst_reg = dst_reg;
+    insn.src_reg = src_reg;
+    insn.off = off;
+    insn.imm = imm;
+    return insn;
+}
+
+/***
+  * 组装XDP程序：目的端口为ports之一的IPv4 UDP包以bpf_redirect_map转到XSKMAP中rx_queue_index对应的套接字，
+  * 该队列没有套接字或其它的包返回XDP_PASS交给内核协议栈
+  */
+static std::vector<struct bpf_insn> assemble_program(int map_fd, const std::vector<uint16_t>& ports)
+{
+    std::vector<struct bpf_insn> insns;
+    std::vector<size_t> pass_jumps;     // 须跳到pass的指令
+    std::vector<size_t> redirect_jumps; // 须跳到redirect的指令
+
+    insns.push_back(make_insn(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));                // r6 = ctx
+    insns.push_back(make_insn(BPF_LDX|BPF_W|BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0));
+    insns.push_back(make_insn(BPF_LDX|BPF_W|BPF_MEM, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0));
+    insns.push_back(make_insn(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_4, BPF_REG_2, 0, 0));
+    insns.push_back(make_insn(BPF_ALU64|BPF_ADD|BPF_K, BPF_REG_4, 0, 0, ETH_HEADER_SIZE+IPV4_HEADER_SIZE+UDP_HEADER_SIZE));
+    pass_jumps.push_back(insns.size());
+    insns.push_back(make_insn(BPF_JMP|BPF_JGT|BPF_X, BPF_REG_4, BPF_REG_3, 0, 0));                  // 不够首部长度
+
+    // 报文中的字段为网络字节序，以主机字节序读出后和htons的结果比较
+    insns.push_back(make_insn(BPF_LDX|BPF_H|BPF_MEM, BPF_REG_5, BPF_REG_2, 12, 0));                 // 以太网类型
+    pass_jumps.push_back(insns.size());
+    insns.push_back(make_insn(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 0, htons(0x0800)));
+    insns.push_back(make_insn(BPF_LDX|BPF_B|BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE, 0));    // 版本和首部长度
+    pass_jumps.push_back(insns.size());
+    insns.push_back(make_insn(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 0, 0x45));
+    insns.push_back(make_insn(BPF_LDX|BPF_H|BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE+6, 0));  // 分片标志和偏移
+    insns.push_back(make_insn(BPF_ALU64|BPF_AND|BPF_K, BPF_REG_5, 0, 0, htons(0x3fff)));
+    pass_jumps.push_back(insns.size());
+    insns.push_back(make_insn(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 0, 0));
+    insns.push_back(make_insn(BPF_LDX|BPF_B|BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE+9, 0));  // 协议
+    pass_jumps.push_back(insns.size());
+    insns.push_back(make_insn(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 0, IPPROTO_UDP));
+    insns.push_back(make_insn(BPF_LDX|BPF_H|BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE+IPV4_HEADER_SIZE+2, 0)); // 目的端口
+    for (std::vector<uint16_t>::size_type i=0; i<ports.size(); ++i)
+    {
+        redirect_jumps.push_back(insns.size());
+        insns.push_back(make_insn(BPF_JMP|BPF_JEQ|BPF_K, BPF_REG_5, 0, 0, htons(ports[i])));
+    }
+    pass_jumps.push_back(insns.size());
+    insns.push_back(make_insn(BPF_JMP|BPF_JA, 0, 0, 0, 0));
+
+    // redirect: return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS)
+    const size_t redirect = insns.size();
+    insns.push_back(make_insn(BPF_LDX|BPF_W|BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0));
+    insns.push_back(make_insn(BPF_LD|BPF_DW|BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd));
+    insns.push_back(make_insn(0, 0, 0, 0, 0));
+    insns.push_back(make_insn(BPF_ALU64|BPF_MOV|BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+    insns.push_back(make_insn(BPF_JMP|BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    insns.push_back(make_insn(BPF_JMP|BPF_EXIT, 0, 0, 0, 0));
+
+    // pass: return XDP_PASS
+    const size_t pass = insns.size();
+    insns.push_back(make_insn(BPF_ALU64|BPF_MOV|BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+    insns.push_back(make_insn(BPF_JMP|BPF_EXIT, 0, 0, 0, 0));
+
+    for (std::vector<size_t>::size_type i=0; i<pass_jumps.size(); ++i)
+        insns[pass_jumps[i]].off = static_cast<int16_t>(pass - pass_jumps[i] - 1);
+    for (std::vector<size_t>::size_type i=0; i<redirect_jumps.size(); ++i)
+        insns[redirect_jumps[i]].off = static_cast<int16_t>(redirect - redirect_jumps[i] - 1);
+    return insns;
+}
+#endif // HAVE_AF_XDP
+
+////////////////////////////////////////////////////////////////////////////////
+CXdpSocket::CXdpSocket()
+    : _umem(NULL), _umem_size(0), _frame_number(0), _frame_size(0), _queue_id(0), _ifindex(0), _zero_copy(false),
+      _map_fd(-1), _prog_fd(-1), _link_fd(-1), _dropped_number(0)
+{
+}
+
+CXdpSocket::~CXdpSocket()
+{
+    destroy();
+}
+
+bool CXdpSocket::is_supported()
+{
+#if HAVE_AF_XDP
+    const int fd = ::socket(AF_XDP, SOCK_RAW, 0);
+    if (-1 == fd)
+        return false;
+    ::close(fd);
+    return true;
+#else
+    return false;
+#endif // HAVE_AF_XDP
+}
+
+void CXdpSocket::create(const std::string& ifname, uint32_t queue_id, uint32_t frame_number, uint32_t frame_size, bool zero_copy)
+{
+#if HAVE_AF_XDP
+    if ((0 == frame_number) || (frame_number & (frame_number-1)) || (frame_size < 2048) || (frame_size & (frame_size-1)))
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, "create");
+
+    destroy();
+    _ifindex = static_cast<int>(if_nametoindex(ifname.c_str()));
+    if (0 == _ifindex)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "if_nametoindex");
+
+    const int fd = ::socket(AF_XDP, SOCK_RAW, 0);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "socket");
+    set_fd(fd);
+    _queue_id = queue_id;
+    _frame_number = frame_number;
+    _frame_size = frame_size;
+
+    try
+    {
+        // UMEM，页对齐并预先分配物理页
+        _umem_size = static_cast<size_t>(frame_number) * frame_size;
+        void* umem = mmap(NULL, _umem_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+        if (MAP_FAILED == umem)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+        _umem = static_cast<char*>(umem);
+
+        struct xdp_umem_reg umem_reg;
+        memset(&umem_reg, 0, sizeof(umem_reg));
+        umem_reg.addr = reinterpret_cast<uint64_t>(_umem);
+        umem_reg.len = _umem_size;
+        umem_reg.chunk_size = frame_size;
+        if (-1 == setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt(XDP_UMEM_REG)");
+
+        // 不发送，完成环只是绑定所必需的，取最小
+        const int ring_size = static_cast<int>(frame_number);
+        const int completion_size = 64;
+        if ((-1 == setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)))
+         || (-1 == setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &completion_size, sizeof(completion_size)))
+         || (-1 == setsockopt(fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size))))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+
+        struct xdp_mmap_offsets offsets;
+        socklen_t offsets_size = sizeof(offsets);
+        if (-1 == getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsets_size))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "getsockopt(XDP_MMAP_OFFSETS)");
+
+        _rx_ring.mask = frame_number - 1;
+        map_ring(&_rx_ring, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc), &offsets.rx);
+        _fill_ring.mask = frame_number - 1;
+        map_ring(&_fill_ring, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t), &offsets.fr);
+        _completion_ring.mask = completion_size - 1;
+        map_ring(&_completion_ring, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t), &offsets.cr);
+
+        struct sockaddr_xdp addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sxdp_family = AF_XDP;
+        addr.sxdp_ifindex = static_cast<uint32_t>(_ifindex);
+        addr.sxdp_queue_id = queue_id;
+        addr.sxdp_flags = XDP_USE_NEED_WAKEUP | (zero_copy? XDP_ZEROCOPY: 0);
+        // 上一个绑定该队列的套接字（如刚退出的进程）由内核延迟释放，期间bind返回EBUSY
+        for (int i=0; -1 == bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)); ++i)
+        {
+            if ((errno != EBUSY) || (i >= XDP_BIND_RETRIES))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "bind");
+            (void)usleep(100000);
+        }
+
+        struct xdp_options options;
+        socklen_t options_size = sizeof(options);
+        _zero_copy = (0 == getsockopt(fd, SOL_XDP, XDP_OPTIONS, &options, &options_size)) && (options.flags & XDP_OPTIONS_ZEROCOPY);
+
+        // 所有帧都交给内核用于接收
+        std::vector<uint64_t> addrs(frame_number);
+        for (uint32_t i=0; i<frame_number; ++i)
+            addrs[i] = static_cast<uint64_t>(i) * frame_size;
+        refill(&addrs[0], frame_number);
+        _recycled.reserve(frame_number);
+    }
+    catch (...)
+    {
+        destroy();
+        throw;
+    }
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, EAFNOSUPPORT, "socket");
+#endif // HAVE_AF_XDP
+}
+
+void CXdpSocket::destroy()
+{
+    // 先卸载程序，不再有包转到本套接字
+    if (_link_fd != -1)
+        ::close(_link_fd);
+    if (_prog_fd != -1)
+        ::close(_prog_fd);
+    if (_map_fd != -1)
+        ::close(_map_fd);
+    _link_fd = _prog_fd = _map_fd = -1;
+
+    unmap_ring(&_rx_ring);
+    unmap_ring(&_fill_ring);
+    unmap_ring(&_completion_ring);
+    if (get_fd() != -1)
+        close();
+    if (_umem != NULL)
+    {
+        (void)munmap(_umem, _umem_size);
+        _umem = NULL;
+    }
+    _recycled.clear();
+}
+
+void CXdpSocket::attach_program(const std::vector<uint16_t>& ports, bool skb_mode)
+{
+#if HAVE_AF_XDP
+    union bpf_attr attr;
+
+    // XSKMAP以接收队列编号为键
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(int);
+    attr.max_entries = _queue_id + 1;
+    _map_fd = bpf(BPF_MAP_CREATE, &attr);
+    if (-1 == _map_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "bpf(BPF_MAP_CREATE)");
+
+    const uint32_t key = _queue_id;
+    const int value = get_fd();
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = static_cast<uint32_t>(_map_fd);
+    attr.key = reinterpret_cast<uint64_t>(&key);
+    attr.value = reinterpret_cast<uint64_t>(&value);
+    if (-1 == bpf(BPF_MAP_UPDATE_ELEM, &attr))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "bpf(BPF_MAP_UPDATE_ELEM)");
+
+    const std::vector<struct bpf_insn> insns = assemble_program(_map_fd, ports);
+    static const char license[] = "Dual BSD/GPL";
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = reinterpret_cast<uint64_t>(&insns[0]);
+    attr.insn_cnt = static_cast<uint32_t>(insns.size());
+    attr.license = reinterpret_cast<uint64_t>(license);
+    _prog_fd = bpf(BPF_PROG_LOAD, &attr);
+    if (-1 == _prog_fd)
+    {
+        // 带上校验器的日志再加载一次，以便知道被拒绝的原因
+        const int errcode = errno;
+        std::vector<char> log(65536, '\0');
+        attr.log_buf = reinterpret_cast<uint64_t>(&log[0]);
+        attr.log_size = static_cast<uint32_t>(log.size());
+        attr.log_level = 1;
+        const int prog_fd = bpf(BPF_PROG_LOAD, &attr);
+        if (prog_fd != -1)
+            ::close(prog_fd);
+        else if (log[0] != '\0')
+            MYLOG_ERROR("XDP program rejected: %s\n", &log[0]);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "bpf(BPF_PROG_LOAD)");
+    }
+
+    // 以bpf_link挂载，关闭_link_fd即卸载，进程异常退出也不会遗留程序
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = static_cast<uint32_t>(_prog_fd);
+    attr.link_create.target_ifindex = static_cast<uint32_t>(_ifindex);
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = skb_mode? XDP_FLAGS_SKB_MODE: 0;
+    _link_fd = bpf(BPF_LINK_CREATE, &attr);
+    if (-1 == _link_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "bpf(BPF_LINK_CREATE)");
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOSYS, "bpf");
+#endif // HAVE_AF_XDP
+}
+
+int CXdpSocket::receive_batch(CUdpMessageArena* arena)
+{
+#if HAVE_AF_XDP
+    const uint32_t producer = __atomic_load_n(_rx_ring.producer, __ATOMIC_ACQUIRE);
+    uint32_t consumer = *_rx_ring.consumer;
+    const struct xdp_desc* descs = static_cast<const struct xdp_desc*>(_rx_ring.descs);
+
+    arena->_number = 0;
+    for (; (consumer != producer) && (arena->_number < arena->_message_number); ++consumer)
+    {
+        const struct xdp_desc& desc = descs[consumer & _rx_ring.mask];
+        const unsigned char* frame = reinterpret_cast<const unsigned char*>(_umem + desc.addr);
+        _recycled.push_back(desc.addr & ~static_cast<uint64_t>(_frame_size-1));
+
+        // XDP程序只转来无选项的IPv4 UDP，这里仍检查，以防程序由别处挂载
+        const size_t ip_header_size = (desc.len > ETH_HEADER_SIZE)? (frame[ETH_HEADER_SIZE] & 0x0f) * 4: 0;
+        const size_t payload_offset = ETH_HEADER_SIZE + ip_header_size + UDP_HEADER_SIZE;
+        if ((desc.len < payload_offset) || (ip_header_size < IPV4_HEADER_SIZE) || (frame[12] != 0x08) || (frame[13] != 0x00)
+         || ((frame[ETH_HEADER_SIZE] >> 4) != 4) || (frame[ETH_HEADER_SIZE+9] != IPPROTO_UDP))
+        {
+            ++_dropped_number;
+            continue;
+        }
+
+        const unsigned char* udp = frame + ETH_HEADER_SIZE + ip_header_size;
+        size_t payload_size = ((static_cast<size_t>(udp[4]) << 8) | udp[5]);
+        payload_size = (payload_size < UDP_HEADER_SIZE)? 0: payload_size - UDP_HEADER_SIZE;
+        if ((payload_size > desc.len - payload_offset) || (payload_size > arena->_message_size))
+        {
+            ++_dropped_number;
+            continue;
+        }
+
+        const uint32_t index = arena->_number++;
+        struct sockaddr_in& from_addr = arena->_addrs[index];
+        memset(&from_addr, 0, sizeof(from_addr));
+        from_addr.sin_family = AF_INET;
+        memcpy(&from_addr.sin_addr.s_addr, frame+ETH_HEADER_SIZE+12, sizeof(from_addr.sin_addr.s_addr));
+        memcpy(&from_addr.sin_port, udp, sizeof(from_addr.sin_port));
+        memcpy(arena->get_data(index), udp+UDP_HEADER_SIZE, payload_size);
+        arena->_iovecs[index].iov_len = payload_size;
+        arena->_mmsghdrs[index].msg_hdr.msg_controllen = 0; // 没有GRO和时间戳的控制信息
+    }
+
+    if (consumer != *_rx_ring.consumer)
+    {
+        __atomic_store_n(_rx_ring.consumer, consumer, __ATOMIC_RELEASE);
+        refill(&_recycled[0], static_cast<uint32_t>(_recycled.size()));
+        _recycled.clear();
+    }
+    return (0 == arena->_number)? -1: static_cast<int>(arena->_number);
+#else
+    return -1;
+#endif // HAVE_AF_XDP
+}
+
+uint64_t CXdpSocket::get_kernel_dropped_number() const
+{
+#if HAVE_AF_XDP
+    struct xdp_statistics statistics;
+    socklen_t statistics_size = sizeof(statistics);
+    if (-1 == getsockopt(get_fd(), SOL_XDP, XDP_STATISTICS, &statistics, &statistics_size))
+        return 0;
+    return statistics.rx_dropped + statistics.rx_ring_full + statistics.rx_fill_ring_empty_descs;
+#else
+    return 0;
+#endif // HAVE_AF_XDP
+}
+
+void CXdpSocket::map_ring(Ring* ring, uint64_t offset, size_t desc_size, const void* ring_offsets)
+{
+#if HAVE_AF_XDP
+    const struct xdp_ring_offset* ring_offset = static_cast<const struct xdp_ring_offset*>(ring_offsets);
+    ring->map_size = ring_offset->desc + (ring->mask + 1) * desc_size;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, get_fd(), static_cast<off_t>(offset));
+    if (MAP_FAILED == ring->map)
+    {
+        ring->map = NULL;
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+    }
+
+    char* map = static_cast<char*>(ring->map);
+    ring->producer = reinterpret_cast<uint32_t*>(map + ring_offset->producer);
+    ring->consumer = reinterpret_cast<uint32_t*>(map + ring_offset->consumer);
+    ring->flags = reinterpret_cast<uint32_t*>(map + ring_offset->flags);
+    ring->descs = map + ring_offset->desc;
+#endif // HAVE_AF_XDP
+}
+
+void CXdpSocket::unmap_ring(Ring* ring)
+{
+    if (ring->map != NULL)
+        (void)munmap(ring->map, ring->map_size);
+    *ring = Ring();
+}
+
+// 将帧放回填充环，内核用它们接收后续的包，填充环和UMEM一样大，所以总放得下
+void CXdpSocket::refill(const uint64_t* addrs, uint32_t number)
+{
+#if HAVE_AF_XDP
+    uint32_t producer = *_fill_ring.producer;
+    uint64_t* descs = static_cast<uint64_t*>(_fill_ring.descs);
+
+    for (uint32_t i=0; i<number; ++i)
+        descs[(producer++) & _fill_ring.mask] = addrs[i];
+    __atomic_store_n(_fill_ring.producer, producer, __ATOMIC_RELEASE);
+
+    // 使用XDP_USE_NEED_WAKEUP时，内核等待填充时须唤醒它
+    if (__atomic_load_n(_fill_ring.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+        (void)recvfrom(get_fd(), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+#endif // HAVE_AF_XDP
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CUdpIngress::CUdpIngress()
+    : _xdp_socket(NULL), _udp_socket(NULL)
+{
+}
+
+CUdpIngress::~CUdpIngress()
+{
+    delete _xdp_socket;
+    delete _udp_socket;
+}
+
+bool CUdpIngress::create(const std::string& ip, uint16_t port, const std::string& ifname, uint32_t queue_id, bool skb_mode)
+{
+    delete _xdp_socket;
+    _xdp_socket = NULL;
+    delete _udp_socket;
+    _udp_socket = new CUdpSocket;
+    _udp_socket->listen(ip, port, true);
+
+    if (!ifname.empty())
+    {
+        CXdpSocket* xdp_socket = new CXdpSocket;
+        try
+        {
+            xdp_socket->create(ifname, queue_id);
+            xdp_socket->attach_program(std::vector<uint16_t>(1, port), skb_mode);
+            _xdp_socket = xdp_socket;
+            MYLOG_INFO("AF_XDP enabled on %s queue %u for port %u (%s)\n", ifname.c_str(), queue_id, port, xdp_socket->is_zero_copy()? "zero copy": "copy");
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            MYLOG_ERROR("AF_XDP on %s queue %u unavailable, fall back to UDP socket: %s\n", ifname.c_str(), queue_id, ex.str().c_str());
+            delete xdp_socket;
+        }
+    }
+
+    return _xdp_socket != NULL;
+}
+
+int CUdpIngress::receive_batch(CUdpMessageArena* arena)
+{
+    if (_xdp_socket != NULL)
+    {
+        const int number = _xdp_socket->receive_batch(arena);
+        if (number > 0)
+            return number;
+    }
+
+    return (NULL == _udp_socket)? -1: _udp_socket->receive_batch(arena);
+}
+
+NET_NAMESPACE_END
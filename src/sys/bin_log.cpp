@@ -0,0 +1,675 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/bin_log.h"
+#include "sys/lock.h"
+#include "sys/syscall_exception.h"
+#include "sys/thread.h"
+#include "utils/compressor.h"
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+// 格式表分块分配，已分配的块不会移动，读时不需要加锁
+#define BIN_LOG_CHUNK_BITS 10
+#define BIN_LOG_CHUNK_SIZE (1 << BIN_LOG_CHUNK_BITS)
+
+// 单条记录的最大字节数，超过的视为损坏
+#define BIN_LOG_RECORD_SIZE_MAX (1024 * 1024)
+
+static CLock sg_bin_log_lock;
+static bin_log_format_t* sg_bin_log_chunks[BIN_LOG_FORMAT_MAX / BIN_LOG_CHUNK_SIZE];
+static uint32_t sg_bin_log_format_number = 1; // 0号保留给文本
+
+uint32_t register_bin_log_format(log_level_t log_level, const char* filename, int lineno, const char* format)
+{
+    LockHelper<CLock> lock_helper(sg_bin_log_lock);
+    const uint32_t format_id = sg_bin_log_format_number;
+    if (format_id >= BIN_LOG_FORMAT_MAX)
+        return BIN_LOG_TEXT_FORMAT_ID;
+
+    bin_log_format_t*& chunk = sg_bin_log_chunks[format_id >> BIN_LOG_CHUNK_BITS];
+    if (NULL == chunk)
+        chunk = new bin_log_format_t[BIN_LOG_CHUNK_SIZE];
+
+    bin_log_format_t& bin_log_format = chunk[format_id & (BIN_LOG_CHUNK_SIZE-1)];
+    bin_log_format.log_level = log_level;
+    bin_log_format.lineno = lineno;
+    bin_log_format.filename = (NULL == filename)? "": filename;
+    bin_log_format.format = (NULL == format)? "": format;
+    bin_log_format.supported = parse_bin_log_format(bin_log_format.format.c_str(), &bin_log_format.arg_types);
+
+    // 先填好格式再增加个数，读者看到个数增加时格式一定已可用
+    __atomic_store_n(&sg_bin_log_format_number, format_id+1, __ATOMIC_RELEASE);
+    return format_id;
+}
+
+const bin_log_format_t* get_bin_log_format(uint32_t format_id)
+{
+    if ((BIN_LOG_TEXT_FORMAT_ID == format_id) || (format_id >= get_bin_log_format_number()))
+        return NULL;
+
+    return &sg_bin_log_chunks[format_id >> BIN_LOG_CHUNK_BITS][format_id & (BIN_LOG_CHUNK_SIZE-1)];
+}
+
+uint32_t get_bin_log_format_number()
+{
+    return __atomic_load_n(&sg_bin_log_format_number, __ATOMIC_ACQUIRE);
+}
+
+bool parse_bin_log_format(const char* format, std::string* arg_types)
+{
+    bool supported = true;
+    const char* p = format;
+
+    arg_types->clear();
+    while (*p != '\0')
+    {
+        if (*p++ != '%')
+            continue;
+        if ('%' == *p)
+        {
+            ++p;
+            continue;
+        }
+
+        // 标志
+        while ((*p != '\0') && (strchr("-+ #0'", *p) != NULL))
+            ++p;
+
+        // 宽度，“*”需要一个int参数
+        if ('*' == *p)
+        {
+            arg_types->push_back('i');
+            ++p;
+        }
+        else
+        {
+            while (isdigit(*p)) ++p;
+        }
+
+        // 精度
+        if ('.' == *p)
+        {
+            ++p;
+            if ('*' == *p)
+            {
+                arg_types->push_back('i');
+                ++p;
+            }
+            else
+            {
+                while (isdigit(*p)) ++p;
+            }
+        }
+
+        // 长度修饰
+        size_t size = sizeof(int);
+        bool wide = false;
+        bool long_double = false;
+        if ('h' == *p)
+        {
+            if ('h' == *++p) ++p;
+        }
+        else if ('l' == *p)
+        {
+            if ('l' == *++p)
+            {
+                ++p;
+                size = sizeof(long long);
+            }
+            else
+            {
+                size = sizeof(long);
+                wide = true;
+            }
+        }
+        else if (('q' == *p) || ('j' == *p))
+        {
+            ++p;
+            size = sizeof(int64_t);
+        }
+        else if ('z' == *p)
+        {
+            ++p;
+            size = sizeof(size_t);
+        }
+        else if ('t' == *p)
+        {
+            ++p;
+            size = sizeof(ptrdiff_t);
+        }
+        else if ('L' == *p)
+        {
+            ++p;
+            long_double = true;
+        }
+
+        switch (*p)
+        {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            arg_types->push_back((8 == size)? 'I': 'i');
+            break;
+        case 'c':
+            arg_types->push_back('i');
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            arg_types->push_back(long_double? 'D': 'd');
+            break;
+        case 's':
+            // 宽字符串无法在读取时还原
+            if (wide) supported = false;
+            arg_types->push_back('s');
+            break;
+        case 'p':
+            arg_types->push_back('p');
+            break;
+        case 'n':
+            // %n需要写回，%m依赖写日志时的errno，都只能在写日志时格式化
+            supported = false;
+            arg_types->push_back('p');
+            break;
+        default:
+            supported = false;
+            break;
+        }
+
+        if (*p != '\0')
+            ++p;
+    }
+
+    return supported;
+}
+
+void fill_bin_log_header(bin_log_header_t* header, uint8_t type, log_level_t log_level, uint32_t format_id, uint32_t length)
+{
+    struct timeval current;
+    gettimeofday(&current, NULL);
+
+    header->magic = BIN_LOG_MAGIC;
+    header->type = type;
+    header->log_level = static_cast<uint8_t>(log_level);
+    header->length = length;
+    header->format_id = format_id;
+    header->thread_id = CThread::get_current_thread_id();
+    header->timestamp = static_cast<uint64_t>(current.tv_sec) * 1000000 + current.tv_usec;
+}
+
+uint32_t encode_bin_log(char* buffer, uint32_t buffer_size, uint32_t format_id, const bin_log_format_t& bin_log_format, va_list& args)
+{
+    uint32_t offset = sizeof(bin_log_header_t);
+
+    for (std::string::size_type i=0; i<bin_log_format.arg_types.size(); ++i)
+    {
+        // 参数总是要取出，放不下的不写入，解码时显示为缺失
+        switch (bin_log_format.arg_types[i])
+        {
+        case 'i':
+            {
+                const int32_t value = va_arg(args, int);
+                if (offset + sizeof(value) <= buffer_size)
+                {
+                    memcpy(buffer+offset, &value, sizeof(value));
+                    offset += sizeof(value);
+                }
+            }
+            break;
+        case 'I':
+            {
+                const int64_t value = va_arg(args, long long);
+                if (offset + sizeof(value) <= buffer_size)
+                {
+                    memcpy(buffer+offset, &value, sizeof(value));
+                    offset += sizeof(value);
+                }
+            }
+            break;
+        case 'd':
+        case 'D':
+            {
+                const double value = ('d' == bin_log_format.arg_types[i])? va_arg(args, double): static_cast<double>(va_arg(args, long double));
+                if (offset + sizeof(value) <= buffer_size)
+                {
+                    memcpy(buffer+offset, &value, sizeof(value));
+                    offset += sizeof(value);
+                }
+            }
+            break;
+        case 's':
+            {
+                const char* str = va_arg(args, const char*);
+                if (NULL == str)
+                    str = "(null)";
+                if (offset + sizeof(uint16_t) <= buffer_size)
+                {
+                    size_t length = strlen(str);
+                    const size_t space = buffer_size - offset - sizeof(uint16_t);
+                    if (length > space)
+                        length = space; // 截断
+                    if (length > 0xFFFF)
+                        length = 0xFFFF;
+
+                    const uint16_t length16 = static_cast<uint16_t>(length);
+                    memcpy(buffer+offset, &length16, sizeof(length16));
+                    memcpy(buffer+offset+sizeof(length16), str, length);
+                    offset += sizeof(length16) + length;
+                }
+            }
+            break;
+        default: // 'p'
+            {
+                const uint64_t value = reinterpret_cast<uintptr_t>(va_arg(args, void*));
+                if (offset + sizeof(value) <= buffer_size)
+                {
+                    memcpy(buffer+offset, &value, sizeof(value));
+                    offset += sizeof(value);
+                }
+            }
+            break;
+        }
+    }
+
+    fill_bin_log_header(reinterpret_cast<bin_log_header_t*>(buffer), BIN_LOG_RECORD_LOG, bin_log_format.log_level, format_id, offset);
+    return offset;
+}
+
+void encode_bin_log_format(std::string* record, uint32_t format_id, const bin_log_format_t& bin_log_format)
+{
+    bin_log_header_t header;
+    const int32_t lineno = bin_log_format.lineno;
+    const uint32_t length = static_cast<uint32_t>(sizeof(header) + sizeof(lineno) + bin_log_format.filename.size() + 1 + bin_log_format.format.size() + 1);
+
+    fill_bin_log_header(&header, BIN_LOG_RECORD_FORMAT, bin_log_format.log_level, format_id, length);
+    record->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    record->append(reinterpret_cast<const char*>(&lineno), sizeof(lineno));
+    record->append(bin_log_format.filename.c_str(), bin_log_format.filename.size()+1);
+    record->append(bin_log_format.format.c_str(), bin_log_format.format.size()+1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 解码
+
+// 用单个转换说明格式化一个值，spec中的“*”依次取自star_values
+template <typename ValueType>
+static void append_value(std::string* text, const std::string& spec, int stars, const int* star_values, ValueType value)
+{
+    char buffer[256];
+    std::vector<char> large_buffer;
+    char* str = buffer;
+    size_t size = sizeof(buffer);
+
+    for (int i=0; i<2; ++i)
+    {
+        int n;
+        if (0 == stars)
+            n = snprintf(str, size, spec.c_str(), value);
+        else if (1 == stars)
+            n = snprintf(str, size, spec.c_str(), star_values[0], value);
+        else
+            n = snprintf(str, size, spec.c_str(), star_values[0], star_values[1], value);
+
+        if (n < 0)
+            break;
+        if (static_cast<size_t>(n) < size)
+        {
+            text->append(str, n);
+            break;
+        }
+
+        large_buffer.resize(n+1);
+        str = &large_buffer[0];
+        size = large_buffer.size();
+    }
+}
+
+template <typename ValueType>
+static bool get_value(const std::string& content, size_t* offset, ValueType* value)
+{
+    if (*offset + sizeof(ValueType) > content.size())
+        return false;
+
+    memcpy(value, content.data()+*offset, sizeof(ValueType));
+    *offset += sizeof(ValueType);
+    return true;
+}
+
+static std::string format_bin_log(const bin_log_format_t& bin_log_format, const std::string& content)
+{
+    std::string text;
+    size_t offset = 0;
+    std::string::size_type arg_index = 0;
+    const std::string& arg_types = bin_log_format.arg_types;
+    const char* p = bin_log_format.format.c_str();
+
+    while (*p != '\0')
+    {
+        if (*p != '%')
+        {
+            text.push_back(*p++);
+            continue;
+        }
+        if ('%' == *++p)
+        {
+            text.push_back(*p++);
+            continue;
+        }
+
+        int stars = 0;
+        int star_values[2] = { 0, 0 };
+        bool missing = false;
+        std::string spec("%");
+
+        // 和parse_bin_log_format相同的顺序：标志、宽度、精度、长度修饰、转换
+        while ((*p != '\0') && (strchr("-+ #0'", *p) != NULL))
+            spec.push_back(*p++);
+        for (int part=0; part<2; ++part)
+        {
+            if (1 == part)
+            {
+                if (*p != '.')
+                    break;
+                spec.push_back(*p++);
+            }
+            if ('*' == *p)
+            {
+                int32_t star_value = 0;
+                if ((arg_index >= arg_types.size()) || !get_value(content, &offset, &star_value))
+                    missing = true;
+                ++arg_index;
+                star_values[stars++] = star_value;
+                spec.push_back(*p++);
+            }
+            else
+            {
+                while (isdigit(*p)) spec.push_back(*p++);
+            }
+        }
+        while ((*p != '\0') && (strchr("hlqjztL", *p) != NULL))
+            ++p;
+
+        const char conversion = *p;
+        if (*p != '\0')
+            ++p;
+        if (missing || (arg_index >= arg_types.size()))
+        {
+            text.append("(?)");
+            continue;
+        }
+
+        // 长度修饰按存储的类型重新生成
+        switch (arg_types[arg_index++])
+        {
+        case 'i':
+            {
+                int32_t value;
+                if (!get_value(content, &offset, &value))
+                    missing = true;
+                else
+                    append_value(&text, spec+conversion, stars, star_values, static_cast<int>(value));
+            }
+            break;
+        case 'I':
+            {
+                int64_t value;
+                if (!get_value(content, &offset, &value))
+                    missing = true;
+                else
+                    append_value(&text, spec+"ll"+conversion, stars, star_values, static_cast<long long>(value));
+            }
+            break;
+        case 'd':
+            {
+                double value;
+                if (!get_value(content, &offset, &value))
+                    missing = true;
+                else
+                    append_value(&text, spec+conversion, stars, star_values, value);
+            }
+            break;
+        case 'D':
+            {
+                double value;
+                if (!get_value(content, &offset, &value))
+                    missing = true;
+                else
+                    append_value(&text, spec+'L'+conversion, stars, star_values, static_cast<long double>(value));
+            }
+            break;
+        case 's':
+            {
+                uint16_t length;
+                if (!get_value(content, &offset, &length) || (offset + length > content.size()))
+                {
+                    missing = true;
+                }
+                else
+                {
+                    const std::string value(content.data()+offset, length);
+                    offset += length;
+                    append_value(&text, spec+'s', stars, star_values, value.c_str());
+                }
+            }
+            break;
+        default: // 'p'
+            {
+                uint64_t value;
+                if (!get_value(content, &offset, &value))
+                    missing = true;
+                else
+                    append_value(&text, spec+'p', stars, star_values, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+            }
+            break;
+        }
+
+        if (missing)
+            text.append("(?)");
+    }
+
+    return text;
+}
+
+CBinLogReader::CBinLogReader()
+    :_fp(NULL)
+    ,_skipped_bytes(0)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+CBinLogReader::~CBinLogReader()
+{
+    close();
+}
+
+void CBinLogReader::open(const char* filepath)
+{
+    close();
+
+    _fp = fopen(filepath, "rb");
+    if (NULL == _fp)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "fopen");
+
+    char magic[4];
+    const size_t magic_size = fread(magic, 1, sizeof(magic), _fp);
+    const utils::compression_t compression = utils::detect_compression(magic, magic_size);
+    if (utils::compression_none == compression)
+    {
+        rewind(_fp);
+        return;
+    }
+
+    // 读取时损坏的数据需要回退查找魔数，因此不流式解压，而是整个解压后以fmemopen读取
+    std::string compressed(magic, magic_size);
+    char buffer[SIZE_64K];
+    for (;;)
+    {
+        const size_t bytes = fread(buffer, 1, sizeof(buffer), _fp);
+        compressed.append(buffer, bytes);
+        if (bytes < sizeof(buffer))
+            break;
+    }
+    if (ferror(_fp))
+    {
+        const int errcode = errno;
+        close();
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "fread");
+    }
+    fclose(_fp);
+    _fp = NULL;
+
+    utils::decompress_data(compression, compressed.data(), compressed.size(), &_data);
+    _fp = _data.empty()? fopen("/dev/null", "rb"): fmemopen(&_data[0], _data.size(), "rb");
+    if (NULL == _fp)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "fmemopen");
+}
+
+void CBinLogReader::close()
+{
+    if (_fp != NULL)
+    {
+        fclose(_fp);
+        _fp = NULL;
+    }
+
+    _data.clear();
+    _skipped_bytes = 0;
+    _content.clear();
+    _formats.clear();
+}
+
+bool CBinLogReader::next(bin_log_header_t* header)
+{
+    while (read_record())
+    {
+        if (BIN_LOG_RECORD_FORMAT == _header.type)
+        {
+            add_format(_header, _content);
+        }
+        else if (BIN_LOG_RECORD_LOG == _header.type)
+        {
+            *header = _header;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CBinLogReader::read_record()
+{
+    for (;;)
+    {
+        if (fread(&_header, sizeof(_header), 1, _fp) != 1)
+        {
+            if (ferror(_fp))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "fread");
+            return false;
+        }
+
+        if ((BIN_LOG_MAGIC == _header.magic)
+         && ((BIN_LOG_RECORD_FORMAT == _header.type) || (BIN_LOG_RECORD_LOG == _header.type))
+         && (_header.length >= sizeof(_header))
+         && (_header.length <= BIN_LOG_RECORD_SIZE_MAX))
+        {
+            _content.resize(_header.length - sizeof(_header));
+            if (_content.empty())
+                return true;
+            if (fread(&_content[0], _content.size(), 1, _fp) == 1)
+                return true;
+
+            // 结尾的不完整记录
+            if (ferror(_fp))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "fread");
+            return false;
+        }
+
+        // 数据损坏，后移一个字节重新查找魔数
+        if (-1 == fseek(_fp, 1 - static_cast<long>(sizeof(_header)), SEEK_CUR))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "fseek");
+        ++_skipped_bytes;
+    }
+}
+
+void CBinLogReader::add_format(const bin_log_header_t& header, const std::string& content)
+{
+    int32_t lineno;
+    if (content.size() < sizeof(lineno))
+        return;
+    memcpy(&lineno, content.data(), sizeof(lineno));
+
+    // 文件名和格式串都以'\0'结尾
+    const std::string::size_type filename_end = content.find('\0', sizeof(lineno));
+    if (std::string::npos == filename_end)
+        return;
+    const std::string::size_type format_end = content.find('\0', filename_end+1);
+    if (std::string::npos == format_end)
+        return;
+
+    // 同一ID出现多次时（如进程重启后追加写同一文件），以最新的为准
+    bin_log_format_t& bin_log_format = _formats[header.format_id];
+    bin_log_format.log_level = static_cast<log_level_t>(header.log_level);
+    bin_log_format.lineno = lineno;
+    bin_log_format.filename = content.substr(sizeof(lineno), filename_end-sizeof(lineno));
+    bin_log_format.format = content.substr(filename_end+1, format_end-filename_end-1);
+    bin_log_format.supported = parse_bin_log_format(bin_log_format.format.c_str(), &bin_log_format.arg_types);
+}
+
+std::string CBinLogReader::get_message() const
+{
+    if (BIN_LOG_TEXT_FORMAT_ID == _header.format_id)
+        return _content;
+
+    std::map<uint32_t, bin_log_format_t>::const_iterator iter = _formats.find(_header.format_id);
+    if (iter == _formats.end())
+    {
+        char message[sizeof("[unknown format: 4294967295]")];
+        snprintf(message, sizeof(message), "[unknown format: %u]", _header.format_id);
+        return message;
+    }
+
+    char location[FILENAME_MAX+sizeof("[:4294967295]")];
+    const bin_log_format_t& bin_log_format = iter->second;
+    snprintf(location, sizeof(location), "[%s:%d]", bin_log_format.filename.c_str(), bin_log_format.lineno);
+    return location + format_bin_log(bin_log_format, _content);
+}
+
+std::string CBinLogReader::get_line() const
+{
+    struct tm result;
+    const time_t seconds = static_cast<time_t>(_header.timestamp / 1000000);
+    const char* log_level_name = get_log_level_name(static_cast<log_level_t>(_header.log_level));
+    char head[sizeof("[2012-12-12 12:12:12/0123456789][0x12345678][DETAIL]")+8];
+
+    localtime_r(&seconds, &result);
+    snprintf(head, sizeof(head), "[%04d-%02d-%02d %02d:%02d:%02d/%u][0x%08x][%s]"
+        , result.tm_year+1900, result.tm_mon+1, result.tm_mday
+        , result.tm_hour, result.tm_min, result.tm_sec
+        , static_cast<unsigned int>(_header.timestamp % 1000000)
+        , _header.thread_id
+        , (NULL == log_level_name)? "": log_level_name);
+
+    std::string line = head + get_message();
+    if (line.empty() || (line[line.size()-1] != '\n'))
+        line.push_back('\n');
+    return line;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,175 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#define MOOON_CLOCK_TSC 1
+#else
+#define MOOON_CLOCK_TSC 0
+#endif
+SYS_NAMESPACE_BEGIN
+
+// 校准TSC的时长（纳秒）
+#define TSC_CALIBRATE_NANOSECONDS 5000000
+
+struct ClockParams
+{
+    CClock::source_t source;
+    uint64_t tsc_frequency;
+    uint64_t base_cycles;      // 校准结束时的TSC
+    uint64_t base_nanoseconds; // 校准结束时CLOCK_MONOTONIC的值，使两种时钟源的起点大致相同
+    uint64_t multiplier;       // 纳秒数 = (周期数 * multiplier) >> 32
+};
+
+static inline uint64_t read_clock(clockid_t clock_id)
+{
+    struct timespec ts;
+    (void)clock_gettime(clock_id, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+static inline uint64_t read_tsc()
+{
+#if MOOON_CLOCK_TSC == 1
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// CPUID.80000007H:EDX[8]，TSC以固定频率递增，不受变频和C状态的影响
+static bool has_invariant_tsc()
+{
+#if MOOON_CLOCK_TSC == 1
+    unsigned int eax, ebx, ecx, edx;
+    return (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) != 0) && ((edx & (1U << 8)) != 0);
+#else
+    return false;
+#endif
+}
+
+// 内核发现TSC不可靠时（如多路CPU间不同步），会切换到其它时钟源，此时也不使用TSC
+static bool kernel_uses_tsc()
+{
+    FILE* fp = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (NULL == fp)
+        return false;
+
+    char source[32];
+    const bool uses_tsc = (fgets(source, sizeof(source), fp) != NULL) && (0 == strncmp(source, "tsc", 3));
+    fclose(fp);
+    return uses_tsc;
+}
+
+// 在两次读TSC之间读CLOCK_MONOTONIC_RAW，取间隔最小的一次，以中点作为对应的TSC值
+static void sample(uint64_t* cycles, uint64_t* nanoseconds)
+{
+    uint64_t min_interval = UINT64_MAX;
+    for (int i=0; i<5; ++i)
+    {
+        const uint64_t start_cycles = read_tsc();
+        const uint64_t now = read_clock(CLOCK_MONOTONIC_RAW);
+        const uint64_t end_cycles = read_tsc();
+        if (end_cycles - start_cycles < min_interval)
+        {
+            min_interval = end_cycles - start_cycles;
+            *cycles = start_cycles + min_interval / 2;
+            *nanoseconds = now;
+        }
+    }
+}
+
+static ClockParams init_params()
+{
+    ClockParams params;
+    memset(&params, 0, sizeof(params));
+    params.source = CClock::source_monotonic;
+    if (!has_invariant_tsc() || !kernel_uses_tsc())
+        return params;
+
+    uint64_t start_cycles, start_nanoseconds;
+    uint64_t end_cycles, end_nanoseconds;
+    sample(&start_cycles, &start_nanoseconds);
+    while (read_clock(CLOCK_MONOTONIC_RAW) - start_nanoseconds < TSC_CALIBRATE_NANOSECONDS)
+        ;
+    sample(&end_cycles, &end_nanoseconds);
+    if ((end_cycles <= start_cycles) || (end_nanoseconds <= start_nanoseconds))
+        return params;
+
+    params.tsc_frequency = static_cast<uint64_t>(static_cast<unsigned __int128>(end_cycles - start_cycles) * 1000000000 / (end_nanoseconds - start_nanoseconds));
+    params.multiplier = static_cast<uint64_t>((static_cast<unsigned __int128>(1000000000) << 32) / params.tsc_frequency);
+    params.base_cycles = read_tsc();
+    params.base_nanoseconds = read_clock(CLOCK_MONOTONIC);
+    params.source = CClock::source_tsc;
+    return params;
+}
+
+// 函数内的静态变量，保证在其它全局对象的构造函数中使用时也已初始化
+static ClockParams& clock_params()
+{
+    static ClockParams params = init_params();
+    return params;
+}
+
+CClock::source_t CClock::get_source()
+{
+    return clock_params().source;
+}
+
+void CClock::disable_tsc()
+{
+    ClockParams& params = clock_params();
+    params.source = source_monotonic;
+    params.tsc_frequency = 0;
+}
+
+uint64_t CClock::get_nanoseconds()
+{
+    const ClockParams& params = clock_params();
+    if (params.source != source_tsc)
+        return read_clock(CLOCK_MONOTONIC);
+
+    // 不同CPU核的TSC可能相差几个周期，按有符号数处理，避免略早于base_cycles时溢出
+    const int64_t cycles = static_cast<int64_t>(read_tsc() - params.base_cycles);
+    const int64_t nanoseconds = static_cast<int64_t>((static_cast<__int128>(cycles) * static_cast<__int128>(params.multiplier)) >> 32);
+    return params.base_nanoseconds + nanoseconds;
+}
+
+uint64_t CClock::get_coarse_nanoseconds()
+{
+    return read_clock(CLOCK_MONOTONIC_COARSE);
+}
+
+uint64_t CClock::get_tsc_frequency()
+{
+    return clock_params().tsc_frequency;
+}
+
+uint64_t CClock::cycles_to_nanoseconds(uint64_t cycles)
+{
+    const ClockParams& params = clock_params();
+    if (params.source != source_tsc)
+        return 0;
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(cycles) * params.multiplier) >> 32);
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,211 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/concurrency_limiter.h"
+#include <algorithm>
+#include <math.h>
+SYS_NAMESPACE_BEGIN
+
+// 耗时最多被容忍为长期平均的倍数，超过时梯度才小于1
+#define GRADIENT_RTT_TOLERANCE 1.5
+
+template <typename T>
+static T clamp_limit(T limit, uint32_t min_limit, uint32_t max_limit)
+{
+    return std::max<T>(static_cast<T>(min_limit), std::min<T>(static_cast<T>(max_limit), limit));
+}
+
+// 在途数不到限制的一半时，限制没有被用到，耗时不能说明限制是否合适
+static bool is_app_limited(uint32_t limit, uint32_t in_flight)
+{
+    return static_cast<uint64_t>(in_flight) * 2 < limit;
+}
+
+CAimdLimit::CAimdLimit(uint32_t initial_limit, uint32_t min_limit, uint32_t max_limit,
+                       uint32_t timeout_milliseconds, double backoff_ratio)
+    : _initial_limit(initial_limit), _min_limit(std::max<uint32_t>(1, min_limit)), _max_limit(std::max(_min_limit, max_limit)),
+      _timeout_nanoseconds(static_cast<uint64_t>(timeout_milliseconds) * 1000000), _backoff_ratio(backoff_ratio)
+{
+}
+
+uint32_t CAimdLimit::update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped)
+{
+    if (dropped || ((_timeout_nanoseconds > 0) && (rtt_nanoseconds > _timeout_nanoseconds)))
+        return clamp_limit(static_cast<uint32_t>(limit * _backoff_ratio), _min_limit, _max_limit);
+    if (is_app_limited(limit, in_flight))
+        return limit;
+    return clamp_limit(limit + 1, _min_limit, _max_limit);
+}
+
+CVegasLimit::CVegasLimit(uint32_t initial_limit, uint32_t min_limit, uint32_t max_limit, uint32_t probe_interval)
+    : _initial_limit(initial_limit), _min_limit(std::max<uint32_t>(1, min_limit)), _max_limit(std::max(_min_limit, max_limit)),
+      _probe_interval(probe_interval), _sample_number(0), _rtt_noload(0)
+{
+}
+
+uint32_t CVegasLimit::update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped)
+{
+    const uint64_t rtt = std::max<uint64_t>(1, rtt_nanoseconds);
+    const int step = std::max(1, static_cast<int>(log10(static_cast<double>(limit))));
+
+    // 重新测量时以本次的耗时为起点，下游变慢后rtt_noload随之变大
+    if ((_probe_interval > 0) && (++_sample_number >= _probe_interval))
+    {
+        _sample_number = 0;
+        _rtt_noload = rtt;
+    }
+    else if ((0 == _rtt_noload) || (rtt < _rtt_noload))
+    {
+        _rtt_noload = rtt;
+    }
+
+    if (dropped)
+        return clamp_limit(static_cast<int64_t>(limit) - step, _min_limit, _max_limit);
+    if (is_app_limited(limit, in_flight))
+        return limit;
+
+    const uint32_t queue = static_cast<uint32_t>(ceil(limit * (1.0 - static_cast<double>(_rtt_noload) / rtt)));
+    int64_t new_limit = limit;
+    if (queue <= static_cast<uint32_t>(step))
+        new_limit += 6 * step; // 几乎没有排队，快速增长
+    else if (queue < static_cast<uint32_t>(3 * step))
+        new_limit += step;
+    else if (queue > static_cast<uint32_t>(6 * step))
+        new_limit -= step;
+    return clamp_limit(new_limit, _min_limit, _max_limit);
+}
+
+CGradientLimit::CGradientLimit(uint32_t initial_limit, uint32_t min_limit, uint32_t max_limit,
+                               double smoothing, uint32_t long_window)
+    : _initial_limit(initial_limit), _min_limit(std::max<uint32_t>(1, min_limit)), _max_limit(std::max(_min_limit, max_limit)),
+      _smoothing(smoothing), _long_window(std::max<uint32_t>(1, long_window)), _long_factor(2.0 / (_long_window + 1)),
+      _long_rtt(0), _queueing_number(0), _queueing_limit(0), _estimated_limit(clamp_limit(initial_limit, _min_limit, _max_limit))
+{
+}
+
+uint32_t CGradientLimit::update(uint32_t limit, uint32_t in_flight, uint64_t rtt_nanoseconds, bool dropped)
+{
+    const double rtt = static_cast<double>(std::max<uint64_t>(1, rtt_nanoseconds));
+    if (0 == _long_rtt)
+    {
+        _long_rtt = rtt;
+    }
+    else if (rtt <= GRADIENT_RTT_TOLERANCE * _long_rtt)
+    {
+        _long_rtt = _long_rtt * (1 - _long_factor) + rtt * _long_factor;
+        _queueing_number = 0;
+    }
+    else
+    {
+        if (0 == _queueing_number)
+            _queueing_limit = _estimated_limit;
+        if (++_queueing_number >= _long_window)
+        {
+            // 持续一个窗口都在排队，限制减半后耗时仍降不下来，说明是下游本身变慢了，以此为新的基准
+            if (_estimated_limit * 2 <= _queueing_limit)
+                _long_rtt = rtt;
+            _queueing_number = 0;
+        }
+    }
+    if (_long_rtt > rtt * 2)
+        _long_rtt *= 0.95;
+
+    if (!dropped && is_app_limited(limit, in_flight))
+        return static_cast<uint32_t>(_estimated_limit);
+
+    const double gradient = dropped? 0.5: std::max(0.5, std::min(1.0, GRADIENT_RTT_TOLERANCE * _long_rtt / rtt));
+    const double new_limit = _estimated_limit * gradient + sqrt(_estimated_limit);
+    _estimated_limit = clamp_limit(_estimated_limit * (1 - _smoothing) + new_limit * _smoothing, _min_limit, _max_limit);
+    return static_cast<uint32_t>(_estimated_limit);
+}
+
+static CGauge* get_limiter_gauge(const std::string& metrics_name, const char* suffix)
+{
+    if (metrics_name.empty())
+        return NULL;
+    return CMetricsRegistry::get_singleton()->get_gauge("concurrency_limiter." + metrics_name + suffix);
+}
+
+static CCounter* get_limiter_counter(const std::string& metrics_name, const char* suffix)
+{
+    if (metrics_name.empty())
+        return NULL;
+    return CMetricsRegistry::get_singleton()->get_counter("concurrency_limiter." + metrics_name + suffix);
+}
+
+CConcurrencyLimiter::CConcurrencyLimiter(ILimitAlgorithm* algorithm, const std::string& metrics_name)
+    : _algorithm(algorithm), _limit(std::max<uint32_t>(1, algorithm->get_initial_limit())), _in_flight(0), _rejected_number(0),
+      _limit_gauge(get_limiter_gauge(metrics_name, ".limit")),
+      _in_flight_gauge(get_limiter_gauge(metrics_name, ".in_flight")),
+      _rejected_counter(get_limiter_counter(metrics_name, ".rejected")),
+      _dropped_counter(get_limiter_counter(metrics_name, ".dropped"))
+{
+    if (_limit_gauge != NULL)
+        _limit_gauge->set(_limit);
+}
+
+CConcurrencyLimiter::~CConcurrencyLimiter()
+{
+    delete _algorithm;
+}
+
+bool CConcurrencyLimiter::try_acquire(CLimitTicket* ticket)
+{
+    uint32_t in_flight = __atomic_load_n(&_in_flight, __ATOMIC_RELAXED);
+    do
+    {
+        if (in_flight >= get_limit())
+        {
+            __atomic_add_fetch(&_rejected_number, 1, __ATOMIC_RELAXED);
+            if (_rejected_counter != NULL)
+                _rejected_counter->inc();
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&_in_flight, &in_flight, in_flight+1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    ticket->in_flight = in_flight + 1;
+    ticket->start_nanoseconds = CClock::get_nanoseconds();
+    if (_in_flight_gauge != NULL)
+        _in_flight_gauge->set(in_flight + 1);
+    return true;
+}
+
+void CConcurrencyLimiter::release(const CLimitTicket& ticket, limit_outcome_t outcome)
+{
+    const uint32_t in_flight = __atomic_sub_fetch(&_in_flight, 1, __ATOMIC_RELEASE);
+    if (_in_flight_gauge != NULL)
+        _in_flight_gauge->set(in_flight);
+    if (limit_ignored == outcome)
+        return;
+
+    const uint64_t rtt_nanoseconds = CClock::get_nanoseconds() - ticket.start_nanoseconds;
+    const bool dropped = (limit_dropped == outcome);
+    if (dropped && (_dropped_counter != NULL))
+        _dropped_counter->inc();
+
+    uint32_t limit;
+    {
+        LockHelper<CAdaptiveLock> lock_helper(_lock);
+        limit = std::max<uint32_t>(1, _algorithm->update(get_limit(), ticket.in_flight, rtt_nanoseconds, dropped));
+        __atomic_store_n(&_limit, limit, __ATOMIC_RELAXED);
+    }
+    if (_limit_gauge != NULL)
+        _limit_gauge->set(limit);
+}
+
+SYS_NAMESPACE_END
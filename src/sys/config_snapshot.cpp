@@ -0,0 +1,382 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/config_snapshot.h"
+#include "sys/thread_engine.h"
+#include "utils/string_utils.h"
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+CConfigCache::CConfigCache()
+    : _snapshot(new CConfigSnapshot), _version(0), _reload_number(0), _reload_failure_number(0),
+      _config_file(NULL), _inotify_fd(-1), _stop_fd(-1), _watch_thread(NULL)
+{
+}
+
+CConfigCache::~CConfigCache()
+{
+    stop_watching();
+}
+
+config_handle_t<bool> CConfigCache::add_bool(const std::string& path, const std::string& name, bool default_value)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    value.bool_value = default_value;
+    config_handle_t<bool> handle = { add_item(path, name, type_bool, value) };
+    return handle;
+}
+
+config_handle_t<int32_t> CConfigCache::add_int32(const std::string& path, const std::string& name, int32_t default_value)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    value.int64_value = default_value;
+    config_handle_t<int32_t> handle = { add_item(path, name, type_int32, value) };
+    return handle;
+}
+
+config_handle_t<int64_t> CConfigCache::add_int64(const std::string& path, const std::string& name, int64_t default_value)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    value.int64_value = default_value;
+    config_handle_t<int64_t> handle = { add_item(path, name, type_int64, value) };
+    return handle;
+}
+
+config_handle_t<uint32_t> CConfigCache::add_uint32(const std::string& path, const std::string& name, uint32_t default_value)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    value.uint64_value = default_value;
+    config_handle_t<uint32_t> handle = { add_item(path, name, type_uint32, value) };
+    return handle;
+}
+
+config_handle_t<uint64_t> CConfigCache::add_uint64(const std::string& path, const std::string& name, uint64_t default_value)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    value.uint64_value = default_value;
+    config_handle_t<uint64_t> handle = { add_item(path, name, type_uint64, value) };
+    return handle;
+}
+
+config_handle_t<std::string> CConfigCache::add_string(const std::string& path, const std::string& name, const std::string& default_value)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    value.string_value = default_value;
+    config_handle_t<std::string> handle = { add_item(path, name, type_string, value) };
+    return handle;
+}
+
+config_handle_t<std::vector<std::string> > CConfigCache::add_string_values(const std::string& path, const std::string& name)
+{
+    CConfigSnapshot::config_value_t value = CConfigSnapshot::config_value_t();
+    config_handle_t<std::vector<std::string> > handle = { add_item(path, name, type_string_values, value) };
+    return handle;
+}
+
+std::shared_ptr<const CConfigSnapshot> CConfigCache::get_snapshot() const
+{
+    return std::atomic_load(&_snapshot);
+}
+
+int CConfigCache::reload(IConfigReader* config_reader)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return do_reload(config_reader);
+}
+
+int CConfigCache::reload_file(IConfigFile* config_file, const std::string& filepath, std::string* error_message)
+{
+    LockHelper<CLock> lock_helper(_lock);
+
+    if (!config_file->open(filepath))
+    {
+        *error_message = utils::CStringUtils::format_string("%s:%d:%d %s",
+            filepath.c_str(), config_file->get_error_row(), config_file->get_error_col(), config_file->get_error_message().c_str());
+        ++_reload_failure_number;
+        return -1;
+    }
+
+    int changed_number = -1;
+    IConfigReader* config_reader = config_file->get_config_reader();
+    if (NULL == config_reader)
+    {
+        *error_message = config_file->get_error_message();
+        ++_reload_failure_number;
+    }
+    else
+    {
+        ConfigReaderHelper config_reader_helper(config_file, config_reader);
+        changed_number = do_reload(config_reader);
+    }
+
+    config_file->close();
+    return changed_number;
+}
+
+void CConfigCache::add_observer(IConfigObserver* observer)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    _observers.push_back(observer);
+}
+
+void CConfigCache::remove_observer(IConfigObserver* observer)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    for (std::vector<IConfigObserver*>::iterator iter=_observers.begin(); iter!=_observers.end(); ++iter)
+    {
+        if (*iter == observer)
+        {
+            _observers.erase(iter);
+            break;
+        }
+    }
+}
+
+void CConfigCache::watch_file(IConfigFile* config_file, const std::string& filepath)
+{
+    stop_watching();
+
+    // 监视所在目录而不是文件本身，以rename方式替换的文件inode已变，监视文件会丢失后续事件
+    std::string dirpath = utils::CStringUtils::extract_dirpath(filepath.c_str());
+    if (dirpath.empty())
+        dirpath = ('/' == filepath[0])? "/": ".";
+
+    _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (-1 == _inotify_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "inotify_init1");
+    if (-1 == inotify_add_watch(_inotify_fd, dirpath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        const int errcode = errno;
+        close(_inotify_fd);
+        _inotify_fd = -1;
+        THROW_SYSCALL_EXCEPTION(dirpath, errcode, "inotify_add_watch");
+    }
+
+    _stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (-1 == _stop_fd)
+    {
+        const int errcode = errno;
+        close(_inotify_fd);
+        _inotify_fd = -1;
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "eventfd");
+    }
+
+    _config_file = config_file;
+    _filepath = filepath;
+    _watch_thread = new CThreadEngine(bind(&CConfigCache::watch, this));
+}
+
+void CConfigCache::stop_watching()
+{
+    if (_watch_thread != NULL)
+    {
+        const uint64_t one = 1;
+        while ((-1 == write(_stop_fd, &one, sizeof(one))) && (EINTR == errno));
+        _watch_thread->join();
+        delete _watch_thread;
+        _watch_thread = NULL;
+    }
+    if (_stop_fd != -1)
+    {
+        close(_stop_fd);
+        _stop_fd = -1;
+    }
+    if (_inotify_fd != -1)
+    {
+        close(_inotify_fd);
+        _inotify_fd = -1;
+    }
+}
+
+uint32_t CConfigCache::add_item(const std::string& path, const std::string& name, value_type_t type, const CConfigSnapshot::config_value_t& default_value)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    item_t item;
+    item.path = path;
+    item.name = name;
+    item.type = type;
+    _items.push_back(item);
+    _default_values.push_back(default_value);
+
+    // 当前快照也要有这一项，否则以新句柄读当前快照会越界
+    const std::shared_ptr<const CConfigSnapshot> old_snapshot = std::atomic_load(&_snapshot);
+    CConfigSnapshot* snapshot = new CConfigSnapshot(*old_snapshot);
+    snapshot->_values.push_back(default_value);
+    publish(snapshot);
+    return static_cast<uint32_t>(_items.size() - 1);
+}
+
+int CConfigCache::do_reload(IConfigReader* config_reader)
+{
+    const std::shared_ptr<const CConfigSnapshot> old_snapshot = std::atomic_load(&_snapshot);
+    std::vector<uint32_t> changed_indexes;
+    CConfigSnapshot* snapshot = new CConfigSnapshot;
+
+    ++_reload_number;
+    snapshot->_values.resize(_items.size());
+    for (std::vector<item_t>::size_type i=0; i<_items.size(); ++i)
+    {
+        read_item(config_reader, static_cast<uint32_t>(i), &snapshot->_values[i]);
+        if (!equal_value(snapshot->_values[i], old_snapshot->_values[i]))
+            changed_indexes.push_back(static_cast<uint32_t>(i));
+    }
+    if (changed_indexes.empty())
+    {
+        delete snapshot;
+        return 0;
+    }
+
+    publish(snapshot);
+    for (std::vector<IConfigObserver*>::size_type i=0; i<_observers.size(); ++i)
+        _observers[i]->on_config_changed(old_snapshot.get(), snapshot, changed_indexes);
+    return static_cast<int>(changed_indexes.size());
+}
+
+// 调用者须持有_lock
+void CConfigCache::publish(CConfigSnapshot* snapshot)
+{
+    snapshot->_version = _version + 1;
+    std::atomic_store(&_snapshot, std::shared_ptr<const CConfigSnapshot>(snapshot));
+
+    // 先发布快照再增加版本号，CConfigCursor看到新版本号时一定能取到新快照
+    __atomic_store_n(&_version, snapshot->_version, __ATOMIC_RELEASE);
+}
+
+void CConfigCache::read_item(IConfigReader* config_reader, uint32_t index, CConfigSnapshot::config_value_t* value) const
+{
+    const item_t& item = _items[index];
+    *value = _default_values[index];
+
+    switch (item.type)
+    {
+    case type_bool:
+        {
+            bool bool_value;
+            value->found = config_reader->get_bool_value(item.path, item.name, bool_value);
+            if (value->found)
+                value->bool_value = bool_value;
+        }
+        break;
+    case type_int32:
+        {
+            int32_t int32_value;
+            value->found = config_reader->get_int32_value(item.path, item.name, int32_value);
+            if (value->found)
+                value->int64_value = int32_value;
+        }
+        break;
+    case type_int64:
+        {
+            int64_t int64_value;
+            value->found = config_reader->get_int64_value(item.path, item.name, int64_value);
+            if (value->found)
+                value->int64_value = int64_value;
+        }
+        break;
+    case type_uint32:
+        {
+            uint32_t uint32_value;
+            value->found = config_reader->get_uint32_value(item.path, item.name, uint32_value);
+            if (value->found)
+                value->uint64_value = uint32_value;
+        }
+        break;
+    case type_uint64:
+        {
+            uint64_t uint64_value;
+            value->found = config_reader->get_uint64_value(item.path, item.name, uint64_value);
+            if (value->found)
+                value->uint64_value = uint64_value;
+        }
+        break;
+    case type_string:
+        {
+            std::string string_value;
+            value->found = config_reader->get_string_value(item.path, item.name, string_value);
+            if (value->found)
+                value->string_value.swap(string_value);
+        }
+        break;
+    case type_string_values:
+        {
+            std::vector<std::string> string_values;
+            value->found = config_reader->get_string_values(item.path, item.name, string_values);
+            if (value->found)
+                value->string_values.swap(string_values);
+        }
+        break;
+    }
+}
+
+void CConfigCache::watch()
+{
+    const std::string filename = utils::CStringUtils::extract_filename(_filepath);
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        struct pollfd fds[2] = { { _inotify_fd, POLLIN, 0 }, { _stop_fd, POLLIN, 0 } };
+        if (-1 == poll(fds, 2, -1))
+        {
+            if (EINTR == errno)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+
+        // 一次读完所有事件，多个事件只reload一次
+        bool matched = false;
+        for (;;)
+        {
+            const ssize_t bytes = read(_inotify_fd, buffer, sizeof(buffer));
+            if (bytes <= 0)
+                break;
+
+            for (ssize_t offset=0; offset<bytes;)
+            {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                if ((event->mask & IN_Q_OVERFLOW) || ((event->len > 0) && (filename == event->name)))
+                    matched = true;
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        if (matched)
+        {
+            std::string error_message;
+            (void)reload_file(_config_file, _filepath, &error_message);
+        }
+    }
+}
+
+bool CConfigCache::equal_value(const CConfigSnapshot::config_value_t& lhs, const CConfigSnapshot::config_value_t& rhs)
+{
+    return (lhs.found == rhs.found)
+        && (lhs.bool_value == rhs.bool_value)
+        && (lhs.int64_value == rhs.int64_value)
+        && (lhs.uint64_value == rhs.uint64_value)
+        && (lhs.string_value == rhs.string_value)
+        && (lhs.string_values == rhs.string_values);
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,450 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/curl_multi.h"
+#include "net/epoller.h"
+#include "utils/string_utils.h"
+
+#if MOOON_HAVE_CURL==1
+#include <curl/curl.h>
+#include <time.h>
+SYS_NAMESPACE_BEGIN
+
+static int64_t get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CCurlShare
+
+static void on_share_lock(CURL* curl, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    static_cast<CCurlShare*>(userptr)->lock(data);
+}
+
+static void on_share_unlock(CURL* curl, curl_lock_data data, void* userptr)
+{
+    static_cast<CCurlShare*>(userptr)->unlock(data);
+}
+
+CCurlShare::CCurlShare()
+    : _share(NULL)
+{
+    CURLSH* share = curl_share_init();
+    if (NULL == share)
+        THROW_EXCEPTION("curl_share_init failed", -1);
+
+    CURLSHcode errcode = curl_share_setopt(share, CURLSHOPT_LOCKFUNC, on_share_lock);
+    if (CURLSHE_OK == errcode)
+        errcode = curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, on_share_unlock);
+    if (CURLSHE_OK == errcode)
+        errcode = curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    if (CURLSHE_OK == errcode)
+        errcode = curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    if (CURLSHE_OK == errcode)
+        errcode = curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    // Added in 7.57.0
+    if (CURLSHE_OK == errcode)
+        errcode = curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    if (errcode != CURLSHE_OK)
+    {
+        curl_share_cleanup(share);
+        THROW_EXCEPTION(curl_share_strerror(errcode), errcode);
+    }
+
+    _share = share;
+}
+
+CCurlShare::~CCurlShare()
+{
+    curl_share_cleanup(static_cast<CURLSH*>(_share));
+}
+
+void CCurlShare::lock(int data)
+{
+    _locks[data % (sizeof(_locks)/sizeof(_locks[0]))].lock();
+}
+
+void CCurlShare::unlock(int data)
+{
+    _locks[data % (sizeof(_locks)/sizeof(_locks[0]))].unlock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CCurlTransfer
+
+static size_t on_transfer_header(void* buffer, size_t size, size_t nmemb, void* userdata)
+{
+    CCurlTransfer* transfer = static_cast<CCurlTransfer*>(userdata);
+    return transfer->on_response_header(static_cast<char*>(buffer), size*nmemb)? size*nmemb: 0;
+}
+
+static size_t on_transfer_body(void* buffer, size_t size, size_t nmemb, void* userdata)
+{
+    CCurlTransfer* transfer = static_cast<CCurlTransfer*>(userdata);
+    return transfer->on_response_body(static_cast<char*>(buffer), size*nmemb)? size*nmemb: 0;
+}
+
+CCurlTransfer::CCurlTransfer(const std::string& url, int data_timeout_seconds, int connect_timeout_seconds, bool enable_insecure)
+    : _curl(NULL), _head_list(NULL), _url(url), _error_buffer(CURL_ERROR_SIZE, '\0')
+{
+    CURL* curl = curl_easy_init();
+    if (NULL == curl)
+        THROW_EXCEPTION("curl_easy_init failed", -1);
+
+    // 由多个传输共享一个线程，不能使用信号实现DNS解析超时
+    CURLcode errcode = curl_easy_setopt(curl, CURLOPT_URL, _url.c_str());
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_PRIVATE, this);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, &_error_buffer[0]);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(data_timeout_seconds));
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, static_cast<long>(connect_timeout_seconds));
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, enable_insecure? 0L: 1L);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, enable_insecure? 0L: 2L);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, on_transfer_header);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_HEADERDATA, this);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_transfer_body);
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+    if (errcode != CURLE_OK)
+    {
+        curl_easy_cleanup(curl);
+        THROW_EXCEPTION(curl_easy_strerror(errcode), errcode);
+    }
+
+    _curl = curl;
+}
+
+CCurlTransfer::~CCurlTransfer()
+{
+    curl_easy_cleanup(static_cast<CURL*>(_curl));
+    if (_head_list != NULL)
+        curl_slist_free_all(static_cast<curl_slist*>(_head_list));
+}
+
+bool CCurlTransfer::add_request_header(const std::string& name_value_pair)
+{
+    curl_slist* head_list = curl_slist_append(static_cast<curl_slist*>(_head_list), name_value_pair.c_str());
+    if (NULL == head_list)
+        return false;
+
+    _head_list = head_list;
+    return true;
+}
+
+void CCurlTransfer::set_post_data(const std::string& data)
+{
+    CURL* curl = static_cast<CURL*>(_curl);
+
+    _post_data = data;
+    CURLcode errcode = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(_post_data.size()));
+    if (CURLE_OK == errcode)
+        errcode = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, _post_data.c_str());
+    if (errcode != CURLE_OK)
+        THROW_EXCEPTION(curl_easy_strerror(errcode), errcode);
+}
+
+int CCurlTransfer::get_response_code() const
+{
+    long response_code = 0;
+    (void)curl_easy_getinfo(static_cast<CURL*>(_curl), CURLINFO_RESPONSE_CODE, &response_code);
+    return static_cast<int>(response_code);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CCurlMulti
+
+// libcurl创建的socket，只注册到CEpoller，不负责关闭
+class CCurlSocket: public net::CEpollable
+{
+public:
+    CCurlSocket(int fd)
+    {
+        set_fd(fd);
+    }
+
+    ~CCurlSocket()
+    {
+        detach();
+    }
+};
+
+static int on_multi_socket(CURL* curl, curl_socket_t fd, int what, void* userp, void* socketp)
+{
+    try
+    {
+        static_cast<CCurlMulti*>(userp)->on_socket(fd, what, socketp);
+        return 0;
+    }
+    catch (CSyscallException& ex)
+    {
+        return -1;
+    }
+}
+
+static int on_multi_timer(CURLM* multi, long timeout_ms, void* userp)
+{
+    static_cast<CCurlMulti*>(userp)->on_timer(timeout_ms);
+    return 0;
+}
+
+CCurlMulti::CCurlMulti(CCurlShare* share, uint32_t max_host_connections, uint32_t max_total_connections)
+    : _share(share), _max_host_connections(max_host_connections), _max_total_connections(max_total_connections),
+      _multi(NULL), _epoller(NULL), _timer_expire(-1), _running_number(0)
+{
+}
+
+CCurlMulti::~CCurlMulti()
+{
+    destroy();
+}
+
+void CCurlMulti::create(uint32_t epoll_size)
+{
+    CURLM* multi = curl_multi_init();
+    if (NULL == multi)
+        THROW_EXCEPTION("curl_multi_init failed", -1);
+
+    _multi = multi;
+    CURLMcode errcode = curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, on_multi_socket);
+    if (CURLM_OK == errcode)
+        errcode = curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+    if (CURLM_OK == errcode)
+        errcode = curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, on_multi_timer);
+    if (CURLM_OK == errcode)
+        errcode = curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+#if LIBCURL_VERSION_NUM >= 0x071E00
+    // Added in 7.30.0
+    if ((CURLM_OK == errcode) && (_max_host_connections > 0))
+        errcode = curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(_max_host_connections));
+    if ((CURLM_OK == errcode) && (_max_total_connections > 0))
+        errcode = curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(_max_total_connections));
+#endif
+    if (errcode != CURLM_OK)
+    {
+        destroy();
+        THROW_EXCEPTION(curl_multi_strerror(errcode), errcode);
+    }
+
+    _epoller = new net::CEpoller;
+    try
+    {
+        _epoller->create(epoll_size);
+    }
+    catch (CSyscallException&)
+    {
+        destroy();
+        throw;
+    }
+}
+
+void CCurlMulti::destroy()
+{
+    if (_multi != NULL)
+    {
+        CURLM* multi = static_cast<CURLM*>(_multi);
+
+        // on_finished中可能delete传输，须先从_transfers中摘除
+        std::map<void*, CCurlTransfer*> transfers;
+        transfers.swap(_transfers);
+        for (std::map<void*, CCurlTransfer*>::iterator iter=transfers.begin(); iter!=transfers.end(); ++iter)
+        {
+            (void)curl_multi_remove_handle(multi, static_cast<CURL*>(iter->first));
+            iter->second->on_finished(CURLE_ABORTED_BY_CALLBACK, curl_easy_strerror(CURLE_ABORTED_BY_CALLBACK));
+        }
+
+        (void)curl_multi_cleanup(multi);
+        _multi = NULL;
+    }
+
+    for (std::map<int, net::CEpollable*>::iterator iter=_sockets.begin(); iter!=_sockets.end(); ++iter)
+        delete iter->second;
+    _sockets.clear();
+    if (_epoller != NULL)
+    {
+        _epoller->destroy();
+        delete _epoller;
+        _epoller = NULL;
+    }
+
+    _timer_expire = -1;
+    _running_number = 0;
+}
+
+void CCurlMulti::add(CCurlTransfer* transfer)
+{
+    CURL* curl = static_cast<CURL*>(transfer->_curl);
+    CURLcode errcode = CURLE_OK;
+
+    if (transfer->_head_list != NULL)
+        errcode = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, static_cast<curl_slist*>(transfer->_head_list));
+    if ((CURLE_OK == errcode) && (_share != NULL))
+        errcode = curl_easy_setopt(curl, CURLOPT_SHARE, static_cast<CURLSH*>(_share->get_share()));
+    if (errcode != CURLE_OK)
+        THROW_EXCEPTION(curl_easy_strerror(errcode), errcode);
+
+    // 加入后libcurl通过timer回调要求尽快处理，传输在下一次run中开始
+    const CURLMcode multi_errcode = curl_multi_add_handle(static_cast<CURLM*>(_multi), curl);
+    if (multi_errcode != CURLM_OK)
+        THROW_EXCEPTION(curl_multi_strerror(multi_errcode), multi_errcode);
+    _transfers.insert(std::make_pair(curl, transfer));
+}
+
+int CCurlMulti::run(uint32_t milliseconds)
+{
+    uint32_t wait_milliseconds = milliseconds;
+    if (_timer_expire != -1)
+    {
+        const int64_t remaining = _timer_expire - get_monotonic_milliseconds();
+        if (remaining < static_cast<int64_t>(wait_milliseconds))
+            wait_milliseconds = (remaining > 0)? static_cast<uint32_t>(remaining): 0;
+    }
+
+    // 先取出所有就绪的socket再交给libcurl，
+    // 因为处理一个socket时，libcurl可能通过socket回调删除同一轮中就绪的另一个socket
+    const int n = _epoller->timed_wait(wait_milliseconds);
+    std::vector<std::pair<int, int> > actions;
+    actions.reserve(n);
+    for (int i=0; i<n; ++i)
+    {
+        net::CEpollable* epollable = _epoller->get(i);
+        const uint32_t events = _epoller->get_events(i);
+
+        if (NULL == dynamic_cast<CCurlSocket*>(epollable))
+        {
+            // wakeup的感应器
+            (void)epollable->handle_epoll_event(NULL, events, NULL);
+            continue;
+        }
+
+        int ev_bitmask = 0;
+        if (events & EPOLLIN)
+            ev_bitmask |= CURL_CSELECT_IN;
+        if (events & EPOLLOUT)
+            ev_bitmask |= CURL_CSELECT_OUT;
+        if (events & (EPOLLERR | EPOLLHUP))
+            ev_bitmask |= CURL_CSELECT_ERR;
+        actions.push_back(std::make_pair(epollable->get_fd(), ev_bitmask));
+    }
+    for (std::vector<std::pair<int, int> >::size_type i=0; i<actions.size(); ++i)
+        socket_action(actions[i].first, actions[i].second);
+
+    if ((_timer_expire != -1) && (get_monotonic_milliseconds() >= _timer_expire))
+    {
+        _timer_expire = -1;
+        socket_action(CURL_SOCKET_TIMEOUT, 0);
+    }
+
+    check_finished();
+    return get_transfer_number();
+}
+
+void CCurlMulti::on_socket(int fd, int what, void* socketp)
+{
+    CCurlSocket* curl_socket = static_cast<CCurlSocket*>(socketp);
+
+    if (CURL_POLL_REMOVE == what)
+    {
+        if (curl_socket != NULL)
+        {
+            _sockets.erase(fd);
+            try
+            {
+                _epoller->del_events(curl_socket);
+            }
+            catch (CSyscallException&)
+            {
+                // socket可能已被关闭，内核已自动从epoll中删除
+            }
+            delete curl_socket;
+        }
+    }
+    else
+    {
+        if (NULL == curl_socket)
+        {
+            curl_socket = new CCurlSocket(fd);
+            _sockets.insert(std::make_pair(fd, curl_socket));
+            (void)curl_multi_assign(static_cast<CURLM*>(_multi), fd, curl_socket);
+        }
+
+        int events = 0;
+        if (what & CURL_POLL_IN)
+            events |= EPOLLIN;
+        if (what & CURL_POLL_OUT)
+            events |= EPOLLOUT;
+        _epoller->set_events(curl_socket, events);
+    }
+}
+
+void CCurlMulti::on_timer(long timeout_ms)
+{
+    _timer_expire = (-1 == timeout_ms)? -1: get_monotonic_milliseconds() + timeout_ms;
+}
+
+void CCurlMulti::socket_action(int fd, int ev_bitmask)
+{
+    const CURLMcode errcode = curl_multi_socket_action(static_cast<CURLM*>(_multi), fd, ev_bitmask, &_running_number);
+    if (errcode != CURLM_OK)
+        THROW_EXCEPTION(curl_multi_strerror(errcode), errcode);
+}
+
+void CCurlMulti::check_finished()
+{
+    CURLM* multi = static_cast<CURLM*>(_multi);
+    CURLMsg* message;
+    int message_number;
+
+    while ((message = curl_multi_info_read(multi, &message_number)) != NULL)
+    {
+        if (message->msg != CURLMSG_DONE)
+            continue;
+
+        CURL* curl = message->easy_handle;
+        const CURLcode result = message->data.result;
+        (void)curl_multi_remove_handle(multi, curl);
+
+        std::map<void*, CCurlTransfer*>::iterator iter = _transfers.find(curl);
+        if (iter != _transfers.end())
+        {
+            CCurlTransfer* transfer = iter->second;
+            const std::string errmsg = (CURLE_OK == result)? std::string(): (transfer->_error_buffer[0] != '\0')? std::string(transfer->_error_buffer.c_str()): std::string(curl_easy_strerror(result));
+
+            _transfers.erase(iter);
+            transfer->on_finished(result, errmsg);
+        }
+    }
+}
+
+SYS_NAMESPACE_END
+#endif // MOOON_HAVE_CURL
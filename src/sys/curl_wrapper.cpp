@@ -1,5 +1,6 @@
 // Writed by yijian, eyjian@qq.com or eyjian@gmail.com
 #include "sys/curl_wrapper.h"
+#include "sys/deadline.h"
 #include "utils/string_utils.h"
 
 #if MOOON_HAVE_CURL==1
@@ -599,7 +600,12 @@ void CCurlWrapper::reset(const std::string& url, const char* cookie, bool enable
 
     // CURLOPT_TIMEOUT
     // In unix-like systems, this might cause signals to be used unless CURLOPT_NOSIGNAL is set.
-    errcode = curl_easy_setopt(curl, CURLOPT_TIMEOUT, _data_timeout_seconds);
+    // 在CDeadlineScope中时以剩余的时间为限，同一截止时间内的多个请求合起来不超过截止时间
+    const CDeadline deadline = CDeadline::get_current();
+    if (deadline.is_infinite())
+        errcode = curl_easy_setopt(curl, CURLOPT_TIMEOUT, _data_timeout_seconds);
+    else
+        errcode = curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(deadline.clamp_milliseconds(_data_timeout_seconds*1000)));
     if (errcode != CURLE_OK)
         THROW_EXCEPTION(curl_easy_strerror(errcode), errcode);
 
@@ -662,7 +668,10 @@ void CCurlWrapper::reset(const std::string& url, const char* cookie, bool enable
 
     // CURLOPT_CONNECTTIMEOUT
     // In unix-like systems, this might cause signals to be used unless CURLOPT_NOSIGNAL is set.
-    errcode = curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, _connect_timeout_seconds);
+    if (deadline.is_infinite())
+        errcode = curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, _connect_timeout_seconds);
+    else
+        errcode = curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(deadline.clamp_milliseconds(_connect_timeout_seconds*1000)));
     if (errcode != CURLE_OK)
         THROW_EXCEPTION(curl_easy_strerror(errcode), errcode);
 
@@ -17,6 +17,8 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include "sys/datetime_utils.h"
+#include "sys/time_thread.h"
+#include <algorithm>
 #include <pthread.h> // localtime_r
 #include <string.h>
 #include <strings.h>
@@ -28,15 +30,340 @@
 #endif
 SYS_NAMESPACE_BEGIN
 
+static const char default_datetime_format[] = "%04d-%02d-%02d %02d:%02d:%02d";
+static const char default_date_format[] = "%04d-%02d-%02d";
+static const char default_time_format[] = "%02d:%02d:%02d";
+static const char digit_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+////////////////////////////////////////////////////////////////////////////////
+// 时区缓存
+
+#define TIMEZONE_BEGIN_YEAR 1970
+#define TIMEZONE_END_YEAR   2100
+#define TIMEZONE_PROBE_STEP (7*24*3600) // 探测间隔，假设一个间隔内最多只有一次切换
+#define MKTIME_PROBE_STRIDE 601200      // mktime在tm_isdst不符时向前后探测的间隔
+#define MKTIME_DELTA_BOUND  (457243200/2 + MKTIME_PROBE_STRIDE) // 以及探测的最远距离
+
+struct TimezoneSegment
+{
+    time_t start;     // 从start起（包含）到下一段的start止，UTC偏移和夏令时不变
+    long offset;      // 本地时间相对UTC的秒数，即tm_gmtoff
+    int isdst;
+    const char* zone; // 即tm_zone，指向tzset维护的字符串
+};
+
+class CTimezoneTable
+{
+public:
+    CTimezoneTable();
+
+    // t不在探测范围内时返回NULL
+    const TimezoneSegment* find(time_t t) const;
+
+    // 由本地时间（从1970-01-01 00:00:00起的秒数）得到UTC时间，
+    // 落在切换的间隙或重叠中，或超出探测范围时返回false
+    bool local_to_utc(int64_t local, int isdst, time_t* t) const;
+
+private:
+    static void probe(time_t t, TimezoneSegment* segment);
+    int find_index(time_t t) const;
+    time_t end_of(int index) const;
+
+private:
+    std::vector<TimezoneSegment> _segments;
+    time_t _end;
+};
+
+// 本线程上次命中的段，连续的转换通常落在同一段中
+static __thread int sg_timezone_hint = 0;
+static int sg_timezone_generation = 0;
+
+CTimezoneTable::CTimezoneTable()
+{
+    const time_t begin = static_cast<time_t>(CDatetimeUtils::days_from_civil(TIMEZONE_BEGIN_YEAR, 1, 1) * 86400);
+    TimezoneSegment current;
+
+    tzset();
+    _end = static_cast<time_t>(CDatetimeUtils::days_from_civil(TIMEZONE_END_YEAR, 1, 1) * 86400);
+    probe(begin, &current);
+    _segments.push_back(current);
+    for (time_t t=begin; t<_end-1;)
+    {
+        const time_t next = std::min(t+TIMEZONE_PROBE_STEP, _end-1);
+        TimezoneSegment segment;
+        probe(next, &segment);
+        if ((segment.offset == current.offset) && (segment.isdst == current.isdst))
+        {
+            t = next;
+            continue;
+        }
+
+        // 二分查找切换点，(low, high]中有且只有一次切换
+        time_t low = t;
+        time_t high = next;
+        while (high - low > 1)
+        {
+            const time_t middle = low + (high - low) / 2;
+            probe(middle, &segment);
+            if ((segment.offset == current.offset) && (segment.isdst == current.isdst))
+                low = middle;
+            else
+                high = middle;
+        }
+
+        probe(high, &current);
+        _segments.push_back(current);
+        t = high;
+    }
+}
+
+const TimezoneSegment* CTimezoneTable::find(time_t t) const
+{
+    const int index = find_index(t);
+    return (-1 == index)? NULL: &_segments[index];
+}
+
+bool CTimezoneTable::local_to_utc(int64_t local, int isdst, time_t* t) const
+{
+    // UTC偏移不会超过一天，因此只需检查local前后一天内的段
+    const int first = find_index(static_cast<time_t>(local - 86400));
+    const int last = find_index(static_cast<time_t>(local + 86400));
+    if ((-1 == first) || (-1 == last))
+        return false;
+
+    int index = -1;
+    for (int i=first; i<=last; ++i)
+    {
+        const time_t utc = static_cast<time_t>(local - _segments[i].offset);
+        if ((utc >= _segments[i].start) && (utc < end_of(i)))
+        {
+            if (index != -1)
+                return false; // 重叠
+            index = i;
+        }
+    }
+    if (-1 == index)
+        return false; // 间隙
+
+    const TimezoneSegment& segment = _segments[index];
+    if ((isdst < 0) || ((isdst != 0) == (segment.isdst != 0)))
+    {
+        *t = static_cast<time_t>(local - segment.offset);
+        return true;
+    }
+
+    // 同mktime：以MKTIME_PROBE_STRIDE为间隔向前后交替探测，使用第一个夏令时与isdst相符的时间的偏移，
+    // 找不到时假设夏令时相差一小时
+    const time_t utc = static_cast<time_t>(local - segment.offset);
+    for (int64_t delta=MKTIME_PROBE_STRIDE; delta<MKTIME_DELTA_BOUND; delta+=MKTIME_PROBE_STRIDE)
+    {
+        for (int direction=-1; direction<=1; direction+=2)
+        {
+            const int probe_index = find_index(static_cast<time_t>(utc + delta*direction));
+            if (-1 == probe_index)
+                return false;
+            if ((isdst != 0) == (_segments[probe_index].isdst != 0))
+            {
+                *t = static_cast<time_t>(local - _segments[probe_index].offset);
+                return true;
+            }
+        }
+    }
+
+    *t = utc + 3600 * (((0 == isdst)? 1: 0) - ((0 == segment.isdst)? 1: 0));
+    return true;
+}
+
+void CTimezoneTable::probe(time_t t, TimezoneSegment* segment)
+{
+    struct tm result;
+    localtime_r(&t, &result);
+    segment->start = t;
+    segment->offset = result.tm_gmtoff;
+    segment->isdst = result.tm_isdst;
+    segment->zone = result.tm_zone;
+}
+
+int CTimezoneTable::find_index(time_t t) const
+{
+    if ((t < _segments[0].start) || (t >= _end))
+        return -1;
+
+    const int hint = sg_timezone_hint;
+    if ((hint < static_cast<int>(_segments.size())) && (t >= _segments[hint].start) && (t < end_of(hint)))
+        return hint;
+
+    int low = 0;
+    int high = static_cast<int>(_segments.size()) - 1;
+    while (low < high)
+    {
+        const int middle = (low + high + 1) / 2;
+        if (_segments[middle].start <= t)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    sg_timezone_hint = low;
+    return low;
+}
+
+time_t CTimezoneTable::end_of(int index) const
+{
+    return (index+1 < static_cast<int>(_segments.size()))? _segments[index+1].start: _end;
+}
+
+// 函数内的静态变量，保证在其它全局对象的构造函数中使用时也已初始化
+static CTimezoneTable*& timezone_table()
+{
+    static CTimezoneTable* table = new CTimezoneTable;
+    return table;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 不经过snprintf和strptime的格式化和解析
+
+static inline bool write_2digits(int n, char* buffer)
+{
+    if ((n < 0) || (n > 99))
+        return false;
+
+    buffer[0] = digit_pairs[n*2];
+    buffer[1] = digit_pairs[n*2+1];
+    return true;
+}
+
+// 以“YYYY-MM-DD”格式写入buffer，不写结尾符，字段超出宽度时返回false
+static bool write_date(int year, int month, int day, char* buffer)
+{
+    if ((year < 0) || (year > 9999))
+        return false;
+
+    buffer[4] = '-';
+    buffer[7] = '-';
+    return write_2digits(year/100, buffer) && write_2digits(year%100, buffer+2)
+        && write_2digits(month, buffer+5) && write_2digits(day, buffer+8);
+}
+
+// 以“hh:mm:ss”格式写入buffer，不写结尾符
+static bool write_time(int hour, int minute, int second, char* buffer)
+{
+    buffer[2] = ':';
+    buffer[5] = ':';
+    return write_2digits(hour, buffer) && write_2digits(minute, buffer+3) && write_2digits(second, buffer+6);
+}
+
+static bool write_datetime(const struct tm& tm, char* buffer)
+{
+    buffer[10] = ' ';
+    return write_date(tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, buffer)
+        && write_time(tm.tm_hour, tm.tm_min, tm.tm_sec, buffer+11);
+}
+
+// format为默认格式时不经过snprintf
+static void format_datetime(const struct tm& tm, const char* format, char* buffer, size_t buffer_size)
+{
+    if ((buffer_size >= sizeof("YYYY-MM-DD hh:mm:ss")) && (0 == strcmp(format, default_datetime_format)) && write_datetime(tm, buffer))
+        buffer[sizeof("YYYY-MM-DD hh:mm:ss")-1] = '\0';
+    else
+        (void)snprintf(buffer, buffer_size, format, tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+static void format_date(const struct tm& tm, const char* format, char* buffer, size_t buffer_size)
+{
+    if ((buffer_size >= sizeof("YYYY-MM-DD")) && (0 == strcmp(format, default_date_format)) && write_date(tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, buffer))
+        buffer[sizeof("YYYY-MM-DD")-1] = '\0';
+    else
+        (void)snprintf(buffer, buffer_size, format, tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday);
+}
+
+static void format_time(const struct tm& tm, const char* format, char* buffer, size_t buffer_size)
+{
+    if ((buffer_size >= sizeof("hh:mm:ss")) && (0 == strcmp(format, default_time_format)) && write_time(tm.tm_hour, tm.tm_min, tm.tm_sec, buffer))
+        buffer[sizeof("hh:mm:ss")-1] = '\0';
+    else
+        (void)snprintf(buffer, buffer_size, format, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+static inline bool parse_2digits(const char* str, int* n)
+{
+    if ((static_cast<unsigned char>(str[0] - '0') > 9) || (static_cast<unsigned char>(str[1] - '0') > 9))
+        return false;
+
+    *n = (str[0] - '0') * 10 + (str[1] - '0');
+    return true;
+}
+
+// 解析固定宽度的“YYYY-MM-DD”，字段的取值范围同strptime
+static bool parse_date(const char* str, int* year, int* month, int* day)
+{
+    int century;
+    if (!parse_2digits(str, &century) || !parse_2digits(str+2, year) || (str[4] != '-')
+     || !parse_2digits(str+5, month) || (str[7] != '-') || !parse_2digits(str+8, day))
+        return false;
+
+    *year += century * 100;
+    return (*month >= 1) && (*month <= 12) && (*day >= 1) && (*day <= 31);
+}
+
+// 解析固定宽度的“YYYY-MM-DD hh:mm:ss”，之后的字符被忽略，不符合时返回false
+static bool parse_datetime(const char* str, struct tm* tm)
+{
+    int year, month, day;
+    if (!parse_date(str, &year, &month, &day) || (str[10] != ' ')
+     || !parse_2digits(str+11, &tm->tm_hour) || (str[13] != ':')
+     || !parse_2digits(str+14, &tm->tm_min) || (str[16] != ':')
+     || !parse_2digits(str+17, &tm->tm_sec))
+        return false;
+    if ((tm->tm_hour > 23) || (tm->tm_min > 59) || (tm->tm_sec > 61))
+        return false;
+
+    const int64_t days = CDatetimeUtils::days_from_civil(year, month, day);
+    tm->tm_year = year - 1900;
+    tm->tm_mon = month - 1;
+    tm->tm_mday = day;
+    tm->tm_wday = static_cast<int>((days % 7 + 11) % 7); // 1970-01-01是周四
+    tm->tm_yday = static_cast<int>(days - CDatetimeUtils::days_from_civil(year, 1, 1));
+    tm->tm_gmtoff = 0;
+    tm->tm_zone = NULL;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 每个线程缓存的当前秒的本地时间，以及已格式化的“YYYY-MM-DD hh:mm:ss”
+
+struct CurrentSecond
+{
+    time_t seconds;
+    int generation;
+    struct tm tm;
+    char datetime[sizeof("YYYY-MM-DD hh:mm:ss")];
+};
+
+static __thread CurrentSecond sg_current_second = { -1, 0 };
+
+static const CurrentSecond& get_current_second(time_t seconds)
+{
+    if ((seconds != sg_current_second.seconds) || (sg_current_second.generation != sg_timezone_generation))
+    {
+        CDatetimeUtils::time2tm(seconds, &sg_current_second.tm);
+        format_datetime(sg_current_second.tm, default_datetime_format, sg_current_second.datetime, sizeof(sg_current_second.datetime));
+        sg_current_second.seconds = seconds;
+        sg_current_second.generation = sg_timezone_generation;
+    }
+
+    return sg_current_second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 bool CDatetimeUtils::is_same_day(time_t t1, time_t t2)
 {
     struct tm result1;
     struct tm result2;
 
-    result1.tm_isdst = 0;
-    result2.tm_isdst = 0;
-    localtime_r(&t1, &result1);
-    localtime_r(&t2, &result2);
+    time2tm(t1, &result1);
+    time2tm(t2, &result2);
 
     return (result1.tm_year == result2.tm_year) &&
            (result1.tm_mon == result2.tm_mon) &&
@@ -51,8 +378,7 @@ bool CDatetimeUtils::is_leap_year(int year)
 uint32_t CDatetimeUtils::time2date(time_t t)
 {
     struct tm result;
-    result.tm_isdst = 0;
-    localtime_r(&t, &result);
+    time2tm(t, &result);
 
     // 20160114
     return (result.tm_year+1900)*10000 + (result.tm_mon+1)*100 + result.tm_mday;
@@ -60,10 +386,94 @@ uint32_t CDatetimeUtils::time2date(time_t t)
 
 time_t CDatetimeUtils::tm2time_t(const struct tm& tm)
 {
+    // 先规范化年月，其它字段超出范围时由整数运算自然进位，同mktime
+    int year = tm.tm_year + 1900 + tm.tm_mon / 12;
+    int month = tm.tm_mon % 12;
+    if (month < 0)
+    {
+        month += 12;
+        --year;
+    }
+
+    const int64_t local = (days_from_civil(year, month+1, 1) + tm.tm_mday - 1) * 86400
+                        + tm.tm_hour * 3600LL + tm.tm_min * 60LL + tm.tm_sec;
+    time_t t;
+    if (timezone_table()->local_to_utc(local, tm.tm_isdst, &t))
+        return t;
+
     struct tm tm_ = tm;
     return mktime(&tm_);
 }
 
+void CDatetimeUtils::time2tm(time_t t, struct tm* tm)
+{
+    const TimezoneSegment* segment = timezone_table()->find(t);
+    if (NULL == segment)
+    {
+        localtime_r(&t, tm);
+        return;
+    }
+
+    const int64_t local = static_cast<int64_t>(t) + segment->offset;
+    int64_t days = local / 86400;
+    int64_t seconds = local % 86400;
+    if (seconds < 0)
+    {
+        seconds += 86400;
+        --days;
+    }
+
+    int year, month, day;
+    civil_from_days(days, &year, &month, &day);
+    tm->tm_year = year - 1900;
+    tm->tm_mon = month - 1;
+    tm->tm_mday = day;
+    tm->tm_hour = static_cast<int>(seconds / 3600);
+    tm->tm_min = static_cast<int>(seconds / 60 % 60);
+    tm->tm_sec = static_cast<int>(seconds % 60);
+    tm->tm_wday = static_cast<int>((days % 7 + 11) % 7); // 1970-01-01是周四
+    tm->tm_yday = static_cast<int>(days - days_from_civil(year, 1, 1));
+    tm->tm_isdst = segment->isdst;
+    tm->tm_gmtoff = segment->offset;
+    tm->tm_zone = segment->zone;
+}
+
+// Howard Hinnant的days_from_civil算法，以400年为一个周期，3月作为一年的第一个月
+int64_t CDatetimeUtils::days_from_civil(int year, int month, int day)
+{
+    const int64_t y = static_cast<int64_t>(year) - ((month <= 2)? 1: 0);
+    const int64_t era = ((y >= 0)? y: y-399) / 400;
+    const int64_t year_of_era = y - era * 400;                                        // [0, 399]
+    const int64_t day_of_year = (153 * (month + ((month > 2)? -3: 9)) + 2) / 5 + day - 1; // [0, 365]
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+void CDatetimeUtils::civil_from_days(int64_t days, int* year, int* month, int* day)
+{
+    const int64_t z = days + 719468;
+    const int64_t era = ((z >= 0)? z: z-146096) / 146097;
+    const int64_t day_of_era = z - era * 146097;                                                            // [0, 146096]
+    const int64_t year_of_era = (day_of_era - day_of_era/1460 + day_of_era/36524 - day_of_era/146096) / 365; // [0, 399]
+    const int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);      // [0, 365]
+    const int64_t mp = (5 * day_of_year + 2) / 153;                                                          // [0, 11]
+
+    *day = static_cast<int>(day_of_year - (153 * mp + 2) / 5 + 1);
+    *month = static_cast<int>((mp < 10)? mp+3: mp-9);
+    *year = static_cast<int>(year_of_era + era * 400 + ((*month <= 2)? 1: 0));
+}
+
+void CDatetimeUtils::reload_timezone()
+{
+    CTimezoneTable*& table = timezone_table();
+    CTimezoneTable* new_table = new CTimezoneTable;
+
+    delete table;
+    table = new_table;
+    sg_timezone_hint = 0;
+    ++sg_timezone_generation;
+}
+
 bool CDatetimeUtils::neighbor_date_bytime(const std::string& datetime, int days, std::string* neighbor_date)
 {
     time_t t;
@@ -84,6 +494,19 @@ std::string CDatetimeUtils::neighbor_date_bytime(const std::string& datetime, in
 
 bool CDatetimeUtils::neighbor_date_bydate(const std::string& date, int days, std::string* neighbor_date)
 {
+    // 按日历直接加减天数，不经过time_t，也不受夏令时切换的影响
+    int year, month, day;
+    if ((date.size() == sizeof("YYYY-MM-DD")-1) && parse_date(date.c_str(), &year, &month, &day))
+    {
+        char date_buffer[sizeof("YYYY-MM-DD")];
+        civil_from_days(days_from_civil(year, month, day) + days, &year, &month, &day);
+        if (write_date(year, month, day, date_buffer))
+        {
+            neighbor_date->assign(date_buffer, sizeof(date_buffer)-1);
+            return true;
+        }
+    }
+
     const std::string datetime = date + std::string(" 00:00:00");
     return neighbor_date_bytime(datetime, days, neighbor_date);
 }
@@ -226,15 +649,11 @@ std::string CDatetimeUtils::extract_standard_year(const std::string& date)
 
 void CDatetimeUtils::get_current_datetime(char* datetime_buffer, size_t datetime_buffer_size, const char* format)
 {
-    struct tm result;
-    time_t now = time(NULL);
-
-    result.tm_isdst = 0;
-    localtime_r(&now, &result);
-    snprintf(datetime_buffer, datetime_buffer_size
-        ,format
-        ,result.tm_year+1900, result.tm_mon+1, result.tm_mday
-        ,result.tm_hour, result.tm_min, result.tm_sec);
+    const CurrentSecond& current_second = get_current_second(time(NULL));
+    if ((datetime_buffer_size >= sizeof(current_second.datetime)) && (0 == strcmp(format, default_datetime_format)))
+        memcpy(datetime_buffer, current_second.datetime, sizeof(current_second.datetime));
+    else
+        format_datetime(current_second.tm, format, datetime_buffer, datetime_buffer_size);
 }
 
 std::string CDatetimeUtils::get_current_datetime(const char* format)
@@ -246,14 +665,7 @@ std::string CDatetimeUtils::get_current_datetime(const char* format)
 
 void CDatetimeUtils::get_current_date(char* date_buffer, size_t date_buffer_size, const char* format)
 {
-    struct tm result;
-    time_t now = time(NULL);
-
-    result.tm_isdst = 0;
-    localtime_r(&now, &result);
-    snprintf(date_buffer, date_buffer_size
-        ,format
-        ,result.tm_year+1900, result.tm_mon+1, result.tm_mday);
+    format_date(get_current_second(time(NULL)).tm, format, date_buffer, date_buffer_size);
 }
 
 std::string CDatetimeUtils::get_current_date(const char* format)
@@ -265,14 +677,7 @@ std::string CDatetimeUtils::get_current_date(const char* format)
 
 void CDatetimeUtils::get_current_time(char* time_buffer, size_t time_buffer_size, const char* format)
 {
-    struct tm result;
-    time_t now = time(NULL);
-
-    result.tm_isdst = 0;
-    localtime_r(&now, &result);
-    snprintf(time_buffer, time_buffer_size
-        ,format
-        ,result.tm_hour, result.tm_min, result.tm_sec);
+    format_time(get_current_second(time(NULL)).tm, format, time_buffer, time_buffer_size);
 }
 
 std::string CDatetimeUtils::get_current_time(const char* format)
@@ -284,9 +689,7 @@ std::string CDatetimeUtils::get_current_time(const char* format)
 
 void CDatetimeUtils::get_current_datetime_struct(struct tm* current_datetime_struct)
 {
-    time_t now = time(NULL);
-    current_datetime_struct->tm_isdst = 0;
-    localtime_r(&now, current_datetime_struct);
+    *current_datetime_struct = get_current_second(time(NULL)).tm;
 }
 
 void CDatetimeUtils::decompose(const struct tm* tm, int* year, int* month, int* day, int64_t* hour, int64_t* minute, int64_t* second)
@@ -350,14 +753,14 @@ void CDatetimeUtils::decompose(const struct tm& tm, std::string* year, std::stri
 void CDatetimeUtils::decompose(time_t t, int* year, int* month, int* day, int64_t* hour, int64_t* minute, int64_t* second)
 {
     struct tm tm;
-    localtime_r(&t, &tm);
+    time2tm(t, &tm);
     decompose(&tm, year, month, day, hour, minute, second);
 }
 
 void CDatetimeUtils::decompose(time_t t, std::string* year, std::string* month, std::string* day, std::string* hour, std::string* minute, std::string* second)
 {
     struct tm tm;
-    localtime_r(&t, &tm);
+    time2tm(t, &tm);
     decompose(&tm, year, month, day, hour, minute, second);
 }
 
@@ -487,10 +890,7 @@ std::string CDatetimeUtils::to_str_long_second(const struct tm& t, const char* p
 
 void CDatetimeUtils::to_current_datetime(const struct tm* current_datetime_struct, char* datetime_buffer, size_t datetime_buffer_size, const char* format)
 {
-    snprintf(datetime_buffer, datetime_buffer_size
-        ,format
-        ,current_datetime_struct->tm_year+1900, current_datetime_struct->tm_mon+1, current_datetime_struct->tm_mday
-        ,current_datetime_struct->tm_hour, current_datetime_struct->tm_min, current_datetime_struct->tm_sec);
+    format_datetime(*current_datetime_struct, format, datetime_buffer, datetime_buffer_size);
 }
 
 std::string CDatetimeUtils::to_current_datetime(const struct tm* current_datetime_struct, const char* format)
@@ -502,9 +902,7 @@ std::string CDatetimeUtils::to_current_datetime(const struct tm* current_datetim
 
 void CDatetimeUtils::to_current_date(const struct tm* current_datetime_struct, char* date_buffer, size_t date_buffer_size, const char* format)
 {
-    snprintf(date_buffer, date_buffer_size
-        ,format
-        ,current_datetime_struct->tm_year+1900, current_datetime_struct->tm_mon+1, current_datetime_struct->tm_mday);
+    format_date(*current_datetime_struct, format, date_buffer, date_buffer_size);
 }
 
 std::string CDatetimeUtils::to_current_date(const struct tm* current_datetime_struct, const char* format)
@@ -516,15 +914,13 @@ std::string CDatetimeUtils::to_current_date(const struct tm* current_datetime_st
 
 void CDatetimeUtils::to_current_time(const struct tm* current_datetime_struct, char* time_buffer, size_t time_buffer_size, const char* format)
 {
-    snprintf(time_buffer, time_buffer_size
-        ,format
-        ,current_datetime_struct->tm_hour, current_datetime_struct->tm_min, current_datetime_struct->tm_sec);
+    format_time(*current_datetime_struct, format, time_buffer, time_buffer_size);
 }
 
 std::string CDatetimeUtils::to_current_time(const struct tm* current_datetime_struct, const char* format)
 {
     char time_buffer[sizeof("HH:SS:MM")+100];
-    to_current_date(current_datetime_struct, time_buffer, sizeof(time_buffer), format);
+    to_current_time(current_datetime_struct, time_buffer, sizeof(time_buffer), format);
     return time_buffer;
 }
 
@@ -604,6 +1000,13 @@ bool CDatetimeUtils::datetime_struct_from_string(const char* str, struct tm* dat
 {
     const char* tmp_str = str;
 
+    // 绝大多数是固定宽度的格式，不需要经过strptime
+    if (parse_datetime(tmp_str, datetime_struct))
+    {
+        datetime_struct->tm_isdst = isdst;
+        return true;
+    }
+
 #ifdef _XOPEN_SOURCE
     const char* p = strptime(tmp_str, "%Y-%m-%d %H:%M:%S", datetime_struct);
     datetime_struct->tm_isdst = isdst;
@@ -719,55 +1122,42 @@ bool CDatetimeUtils::datetime_struct_from_string(const char* str, time_t* dateti
     struct tm datetime_struct;
     if (!datetime_struct_from_string(str, &datetime_struct, isdst)) return false;
 
-    *datetime = mktime(&datetime_struct);
+    *datetime = tm2time_t(datetime_struct);
     return true;
 }
 
 std::string CDatetimeUtils::to_string(time_t datetime, const char* format)
 {
     struct tm result;
-    result.tm_isdst = 0;
-    localtime_r(&datetime, &result);
+    time2tm(datetime, &result);
 
     char datetime_buffer[sizeof("YYYY-MM-DD HH:SS:MM")+100];
-    (void)snprintf(datetime_buffer, sizeof(datetime_buffer)
-        ,format
-        ,result.tm_year+1900, result.tm_mon+1, result.tm_mday
-        ,result.tm_hour, result.tm_min, result.tm_sec);
-
+    format_datetime(result, format, datetime_buffer, sizeof(datetime_buffer));
     return datetime_buffer;
 }
 
 std::string CDatetimeUtils::to_datetime(time_t datetime, const char* format)
 {
-    return CDatetimeUtils::to_string(datetime);
+    return CDatetimeUtils::to_string(datetime, format);
 }
 
 std::string CDatetimeUtils::to_date(time_t datetime, const char* format)
 {
     struct tm result;
-    result.tm_isdst = 0;
-    localtime_r(&datetime, &result);
+    time2tm(datetime, &result);
 
     char date_buffer[sizeof("YYYY-MM-DD")+100];
-    (void)snprintf(date_buffer, sizeof(date_buffer)
-        ,format
-        ,result.tm_year+1900, result.tm_mon+1, result.tm_mday);
-
+    format_date(result, format, date_buffer, sizeof(date_buffer));
     return date_buffer;
 }
 
 std::string CDatetimeUtils::to_time(time_t datetime, const char* format)
 {
     struct tm result;
-    result.tm_isdst = 0;
-    localtime_r(&datetime, &result);
+    time2tm(datetime, &result);
 
     char time_buffer[sizeof("HH:SS:MM")+100];
-    (void)snprintf(time_buffer, sizeof(time_buffer)
-        ,format
-        ,result.tm_hour, result.tm_min, result.tm_sec);
-
+    format_time(result, format, time_buffer, sizeof(time_buffer));
     return time_buffer;
 }
 
@@ -826,8 +1216,7 @@ void CDatetimeUtils::get_datetime_number(const time_t* t, int* year, int* month,
     struct tm* tm_ = NULL;
     if (t != NULL)
     {
-        tm.tm_isdst = 0;
-        localtime_r(t, &tm);
+        time2tm(*t, &tm);
         tm_ = &tm;
     }
 
@@ -1002,23 +1391,16 @@ void get_formatted_current_datetime(char* datetime_buffer, size_t datetime_buffe
     gettimeofday(&current, NULL);
     time_t current_seconds = current.tv_sec;
 
-    struct tm result;
-    result.tm_isdst = 0;
-    localtime_r(&current_seconds, &result);
-
+    const CurrentSecond& current_second = get_current_second(current_seconds);
     if (with_milliseconds)
     {
         snprintf(datetime_buffer, datetime_buffer_size
-            ,"%04d-%02d-%02d %02d:%02d:%02d/%u"
-            ,result.tm_year+1900, result.tm_mon+1, result.tm_mday
-            ,result.tm_hour, result.tm_min, result.tm_sec, (unsigned int)(current.tv_usec));
+            ,"%s/%u", current_second.datetime, (unsigned int)(current.tv_usec));
     }
     else
     {
         snprintf(datetime_buffer, datetime_buffer_size
-            ,"%04d-%02d-%02d %02d:%02d:%02d"
-            ,result.tm_year+1900, result.tm_mon+1, result.tm_mday
-            ,result.tm_hour, result.tm_min, result.tm_sec);
+            ,"%s", current_second.datetime);
     }
 }
 
@@ -1035,6 +1417,46 @@ std::string get_formatted_current_datetime(bool with_milliseconds)
 #endif
 }
 
+int get_cached_formatted_datetime(char* datetime_buffer, size_t datetime_buffer_size, bool with_microseconds, const CTimeThread* time_thread)
+{
+    static const int datetime_length = sizeof("YYYY-MM-DD hh:mm:ss") - 1;
+    time_t current_seconds;
+    uint32_t current_microseconds = 0;
+
+    if ((time_thread != NULL) && !with_microseconds)
+    {
+        current_seconds = static_cast<time_t>(time_thread->get_seconds());
+    }
+    else
+    {
+        struct timeval current;
+        gettimeofday(&current, NULL);
+        current_seconds = current.tv_sec;
+        current_microseconds = static_cast<uint32_t>(current.tv_usec);
+    }
+
+    const CurrentSecond& current_second = get_current_second(current_seconds);
+    const int max_length = with_microseconds?
+        static_cast<int>(sizeof("YYYY-MM-DD hh:mm:ss/0123456789")) - 1: datetime_length;
+    if (datetime_buffer_size <= static_cast<size_t>(max_length))
+    {
+        // 缓冲区不够，退回到慢的方式
+        get_formatted_current_datetime(datetime_buffer, datetime_buffer_size, with_microseconds);
+        return static_cast<int>(strlen(datetime_buffer));
+    }
+
+    memcpy(datetime_buffer, current_second.datetime, datetime_length);
+    int length = datetime_length;
+    if (with_microseconds)
+    {
+        datetime_buffer[length++] = '/';
+        length += utils::CStringUtils::uint64_toa(current_microseconds, datetime_buffer+length);
+    }
+
+    datetime_buffer[length] = '\0';
+    return length;
+}
+
 uint32_t date2day(const std::string& date)
 {
     const std::string& datetime = date + std::string(" 00:00:00");
@@ -0,0 +1,277 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/db_batch_inserter.h"
+#include "sys/thread_engine.h"
+#include "utils/string_utils.h"
+SYS_NAMESPACE_BEGIN
+
+// 未设置时，批的最大行数和字节数，
+// 字节数小于MySQL 5.7的max_allowed_packet默认值4MB
+#define DB_BATCH_MAX_ROWS_DEFAULT  1000
+#define DB_BATCH_MAX_BYTES_DEFAULT (1024*1024)
+
+// 为协议包头等预留的字节数
+#define DB_BATCH_PACKET_RESERVED 1024
+
+CDBBatchInserter::CDBBatchInserter(DBConnection* db_connection, const std::string& table_name, const std::string& field_names)
+    : _db_connection(db_connection), _max_rows(DB_BATCH_MAX_ROWS_DEFAULT), _max_bytes(DB_BATCH_MAX_BYTES_DEFAULT), _ignore(false),
+      _batch_rows(0), _row_number(0),
+      _engine(NULL), _max_pending_batches(0), _executing(false), _stop(false), _async_error(NULL),
+      _batch_number(0), _affected_rows(0)
+{
+    _insert_prefix = table_name;
+    if (!field_names.empty())
+    {
+        _insert_prefix.append(" (");
+        _insert_prefix.append(field_names);
+        _insert_prefix.append(")");
+    }
+    _insert_prefix.append(" VALUES ");
+}
+
+CDBBatchInserter::~CDBBatchInserter()
+{
+    if (_engine != NULL)
+    {
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            _stop = true;
+            _not_empty.signal();
+        }
+
+        _engine->join();
+        delete _engine;
+        _engine = NULL;
+    }
+
+    for (std::deque<std::string*>::iterator iter=_batches.begin(); iter!=_batches.end(); ++iter)
+        delete *iter;
+    delete _async_error;
+}
+
+void CDBBatchInserter::set_max_bytes_by_server()
+{
+    const std::string max_allowed_packet = _db_connection->query("SELECT @@max_allowed_packet");
+    uint64_t packet_size = 0;
+
+    if (utils::CStringUtils::string2int(max_allowed_packet.c_str(), packet_size)
+     && (packet_size > 2*DB_BATCH_PACKET_RESERVED))
+        _max_bytes = packet_size - DB_BATCH_PACKET_RESERVED;
+}
+
+void CDBBatchInserter::start_async(uint32_t max_pending_batches)
+{
+    MOOON_ASSERT(NULL == _engine);
+
+    _max_pending_batches = (0 == max_pending_batches)? 1: max_pending_batches;
+    _engine = new CThreadEngine(bind(&CDBBatchInserter::run, this));
+}
+
+void CDBBatchInserter::add_row(const DBRow& row)
+{
+    _row = "(";
+    for (DBRow::size_type i=0; i<row.size(); ++i)
+    {
+        if (i > 0)
+            _row.push_back(',');
+        append_value(row[i].data(), row[i].size());
+    }
+    _row.push_back(')');
+    append_row();
+}
+
+void CDBBatchInserter::add_row(const DBCursor& cursor)
+{
+    _row = "(";
+    for (int i=0; i<cursor.get_field_number(); ++i)
+    {
+        const DBField& field = cursor.get_field(i);
+
+        if (i > 0)
+            _row.push_back(',');
+        if (field.is_null)
+            _row.append("NULL");
+        else
+            append_value(field.data, field.size);
+    }
+    _row.push_back(')');
+    append_row();
+}
+
+void CDBBatchInserter::flush()
+{
+    submit();
+
+    if (_engine != NULL)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        while (!_batches.empty() || _executing)
+            _not_full.wait(_lock);
+    }
+
+    rethrow_async_error();
+}
+
+uint64_t CDBBatchInserter::get_batch_number() const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _batch_number;
+}
+
+uint64_t CDBBatchInserter::get_affected_rows() const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _affected_rows;
+}
+
+void CDBBatchInserter::append_value(const char* data, size_t size)
+{
+    _row.push_back('\'');
+    _db_connection->append_escaped_string(data, size, &_row);
+    _row.push_back('\'');
+}
+
+void CDBBatchInserter::append_row()
+{
+    rethrow_async_error();
+
+    // 加上这一行会超过max_bytes时，先执行已攒的，
+    // 单独一行就超过时仍单独执行，由DB报错
+    const size_t suffix_size = _update_clause.empty()? 0: _update_clause.size() + sizeof(" ON DUPLICATE KEY UPDATE ");
+    if ((_batch_rows > 0) && (_sql.size() + 1 + _row.size() + suffix_size > _max_bytes))
+        submit();
+
+    if (0 == _batch_rows)
+    {
+        _sql = _ignore? "INSERT IGNORE INTO ": "INSERT INTO ";
+        _sql.append(_insert_prefix);
+    }
+    else
+    {
+        _sql.push_back(',');
+    }
+    _sql.append(_row);
+    ++_row_number;
+
+    if (++_batch_rows >= _max_rows)
+        submit();
+}
+
+void CDBBatchInserter::execute(const std::string& sql)
+{
+    const uint64_t affected_rows = _db_connection->update("%s", sql.c_str());
+
+    LockHelper<CLock> lock_helper(_lock);
+    ++_batch_number;
+    _affected_rows += affected_rows;
+}
+
+void CDBBatchInserter::submit()
+{
+    if (0 == _batch_rows)
+        return;
+
+    if (!_update_clause.empty())
+    {
+        _sql.append(" ON DUPLICATE KEY UPDATE ");
+        _sql.append(_update_clause);
+    }
+    _batch_rows = 0;
+
+    if (NULL == _engine)
+    {
+        execute(_sql);
+    }
+    else
+    {
+        // 交给后台线程，本线程接着拼接下一批
+        std::string* batch = new std::string;
+        batch->swap(_sql);
+        _sql.reserve(batch->size());
+
+        LockHelper<CLock> lock_helper(_lock);
+        while (_batches.size() >= _max_pending_batches)
+            _not_full.wait(_lock);
+        _batches.push_back(batch);
+        _not_empty.signal();
+    }
+}
+
+void CDBBatchInserter::rethrow_async_error()
+{
+    if (NULL == _engine)
+        return;
+
+    CDBException* async_error;
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        async_error = _async_error;
+        _async_error = NULL;
+    }
+
+    if (async_error != NULL)
+    {
+        const CDBException db_error(*async_error);
+        delete async_error;
+        throw db_error;
+    }
+}
+
+void CDBBatchInserter::run()
+{
+    for (;;)
+    {
+        std::string* batch;
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            while (_batches.empty() && !_stop)
+                _not_empty.wait(_lock);
+            if (_batches.empty())
+                break;
+            batch = _batches.front();
+            _batches.pop_front();
+            _executing = true;
+        }
+
+        CDBException* db_error = NULL;
+        try
+        {
+            execute(*batch);
+        }
+        catch (CDBException& ex)
+        {
+            db_error = new CDBException(ex);
+        }
+        delete batch;
+
+        LockHelper<CLock> lock_helper(_lock);
+        _executing = false;
+        if (db_error != NULL)
+        {
+            // 只保留第一个错误
+            if (NULL == _async_error)
+                _async_error = db_error;
+            else
+                delete db_error;
+        }
+        _not_full.broadcast();
+    }
+}
+
+SYS_NAMESPACE_END
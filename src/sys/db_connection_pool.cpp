@@ -0,0 +1,350 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/db_connection_pool.h"
+#include "sys/metrics.h"
+#include "sys/mysql_db.h"
+#include "utils/scoped_ptr.h"
+#include <time.h>
+SYS_NAMESPACE_BEGIN
+
+static uint64_t get_monotonic_microseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 所有连接池共用的度量
+static CLatencyHistogram* get_borrow_wait_histogram()
+{
+    static CLatencyHistogram* histogram = CMetricsRegistry::get_singleton()->get_histogram("db_pool.borrow_wait_ns");
+    return histogram;
+}
+
+static CCounter* get_borrow_timeout_counter()
+{
+    static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("db_pool.borrow_timeout");
+    return counter;
+}
+
+CDBConnectionPool::CDBConnectionPool()
+    : _db_port(3306),
+      _connect_timeout_seconds(DB_CONNECT_TIMEOUT_SECONDS_DEFAULT), _read_timeout_seconds(DB_READ_TIMEOUT_SECONDS_DEFAULT), _write_timeout_seconds(DB_WRITE_TIMEOUT_SECONDS_DEFAULT),
+      _pool_size(0), _idle_ping_microseconds(0), _limiter(NULL), _connection_number(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+CDBConnectionPool::~CDBConnectionPool()
+{
+    destroy();
+}
+
+void CDBConnectionPool::set_host(const std::string& db_ip, uint16_t db_port)
+{
+    _db_ip = db_ip;
+    _db_port = db_port;
+}
+
+void CDBConnectionPool::set_db_name(const std::string& db_name)
+{
+    _db_name = db_name;
+}
+
+void CDBConnectionPool::set_user(const std::string& db_user, const std::string& db_password)
+{
+    _db_user = db_user;
+    _db_password = db_password;
+}
+
+void CDBConnectionPool::set_charset(const std::string& charset)
+{
+    _charset = charset;
+}
+
+void CDBConnectionPool::set_timeout_seconds(int connect_timeout_seconds, int read_timeout_seconds, int write_timeout_seconds)
+{
+    _connect_timeout_seconds = connect_timeout_seconds;
+    _read_timeout_seconds = read_timeout_seconds;
+    _write_timeout_seconds = write_timeout_seconds;
+}
+
+void CDBConnectionPool::create(uint32_t pool_size, uint32_t idle_ping_seconds, uint32_t init_size)
+{
+    _pool_size = (0 == pool_size)? 1: pool_size;
+    _idle_ping_microseconds = static_cast<uint64_t>(idle_ping_seconds) * 1000000;
+
+    for (uint32_t i=0; (i<init_size) && (i<_pool_size); ++i)
+    {
+        IdleConnection idle_connection;
+        idle_connection.db_connection = open_connection();
+        idle_connection.idle_time = get_monotonic_microseconds();
+
+        LockHelper<CLock> lock_helper(_lock);
+        ++_connection_number;
+        _idle_connections.push_back(idle_connection);
+    }
+}
+
+void CDBConnectionPool::destroy()
+{
+    std::vector<IdleConnection> idle_connections;
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        idle_connections.swap(_idle_connections);
+        _connection_number -= static_cast<uint32_t>(idle_connections.size());
+    }
+
+    // close会和服务端交互，不在锁内进行
+    for (std::vector<IdleConnection>::size_type i=0; i<idle_connections.size(); ++i)
+    {
+        idle_connections[i].db_connection->close();
+        delete idle_connections[i].db_connection;
+    }
+}
+
+DBConnection* CDBConnectionPool::borrow(uint32_t milliseconds)
+{
+    CLimitTicket ticket;
+    if ((_limiter != NULL) && !_limiter->try_acquire(&ticket))
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        ++_stats.limit_rejected_number;
+        return NULL;
+    }
+
+    DBConnection* db_connection = NULL;
+    try
+    {
+        db_connection = borrow_connection(milliseconds, ticket);
+    }
+    catch (CDBException&)
+    {
+        if (_limiter != NULL)
+            _limiter->release(ticket, limit_dropped);
+        throw;
+    }
+
+    // 等不到连接说明借出的连接都还没有归还，是过载的信号
+    if ((NULL == db_connection) && (_limiter != NULL))
+        _limiter->release(ticket, limit_dropped);
+    return db_connection;
+}
+
+DBConnection* CDBConnectionPool::borrow_connection(uint32_t milliseconds, const CLimitTicket& ticket)
+{
+    const uint64_t start_time = get_monotonic_microseconds();
+    const uint64_t deadline = start_time + static_cast<uint64_t>(milliseconds) * 1000;
+    DBConnection* db_connection = NULL;
+    uint64_t idle_time = 0;
+
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        for (;;)
+        {
+            if (!_idle_connections.empty())
+            {
+                db_connection = _idle_connections.back().db_connection;
+                idle_time = _idle_connections.back().idle_time;
+                _idle_connections.pop_back();
+                break;
+            }
+            if (_connection_number < _pool_size)
+            {
+                // 先占位，在锁外建立连接
+                ++_connection_number;
+                break;
+            }
+
+            const uint64_t now = get_monotonic_microseconds();
+            if (now >= deadline)
+            {
+                ++_stats.borrow_timeout_number;
+                get_borrow_timeout_counter()->inc();
+                return NULL;
+            }
+
+            ++_stats.waiting_number;
+            (void)_event.timed_wait(_lock, static_cast<uint32_t>((deadline - now + 999) / 1000));
+            --_stats.waiting_number;
+        }
+
+        const uint64_t wait_microseconds = get_monotonic_microseconds() - start_time;
+        _stats.wait_microseconds += wait_microseconds;
+        if (wait_microseconds > _stats.max_wait_microseconds)
+            _stats.max_wait_microseconds = wait_microseconds;
+        get_borrow_wait_histogram()->record(wait_microseconds * 1000);
+    }
+
+    if (NULL == db_connection)
+    {
+        try
+        {
+            db_connection = open_connection();
+        }
+        catch (CDBException&)
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            --_connection_number;
+            _event.signal();
+            throw;
+        }
+    }
+    else
+    {
+        validate_connection(db_connection, idle_time);
+    }
+
+    BusyConnection busy_connection;
+    busy_connection.borrow_time = get_monotonic_microseconds();
+    busy_connection.ticket = ticket;
+
+    LockHelper<CLock> lock_helper(_lock);
+    _busy_connections[db_connection] = busy_connection;
+    ++_stats.borrow_number;
+    return db_connection;
+}
+
+void CDBConnectionPool::pay_back(DBConnection* db_connection, bool broken)
+{
+    {
+        const uint64_t now = get_monotonic_microseconds();
+        LockHelper<CLock> lock_helper(_lock);
+        std::map<DBConnection*, BusyConnection>::iterator iter = _busy_connections.find(db_connection);
+        if (iter != _busy_connections.end())
+        {
+            const uint64_t hold_microseconds = now - iter->second.borrow_time;
+            if (_limiter != NULL)
+                _limiter->release(iter->second.ticket, broken? limit_dropped: limit_success);
+            _stats.hold_microseconds += hold_microseconds;
+            if (hold_microseconds > _stats.max_hold_microseconds)
+                _stats.max_hold_microseconds = hold_microseconds;
+            _busy_connections.erase(iter);
+        }
+
+        if (!broken)
+        {
+            IdleConnection idle_connection;
+            idle_connection.db_connection = db_connection;
+            idle_connection.idle_time = now;
+            _idle_connections.push_back(idle_connection);
+            _event.signal();
+            return;
+        }
+
+        ++_stats.broken_number;
+    }
+
+    release_connection(db_connection);
+}
+
+void CDBConnectionPool::get_stats(DBConnectionPoolStats* stats) const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    *stats = _stats;
+    stats->connection_number = _connection_number;
+    stats->idle_number = static_cast<uint32_t>(_idle_connections.size());
+}
+
+DBConnection* CDBConnectionPool::create_connection()
+{
+#if MOOON_HAVE_MYSQL==1
+    return new CMySQLConnection;
+#else
+    THROW_DB_EXCEPTION(NULL, "mysql not supported", DB_NOT_SUPPORTED);
+#endif // MOOON_HAVE_MYSQL
+}
+
+DBConnection* CDBConnectionPool::open_connection()
+{
+    utils::ScopedPtr<DBConnection> db_connection(create_connection());
+
+    db_connection->set_host(_db_ip, _db_port);
+    db_connection->set_db_name(_db_name);
+    db_connection->set_user(_db_user, _db_password);
+    if (!_charset.empty())
+        db_connection->set_charset(_charset);
+    db_connection->set_timeout_seconds(_connect_timeout_seconds, _read_timeout_seconds, _write_timeout_seconds);
+
+    try
+    {
+        db_connection->open();
+    }
+    catch (CDBException&)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        ++_stats.open_failure_number;
+        throw;
+    }
+
+    LockHelper<CLock> lock_helper(_lock);
+    ++_stats.open_number;
+    return db_connection.release();
+}
+
+void CDBConnectionPool::validate_connection(DBConnection* db_connection, uint64_t idle_time)
+{
+    // 刚用过的连接不ping，省去一次往返
+    if (get_monotonic_microseconds() - idle_time < _idle_ping_microseconds)
+        return;
+
+    try
+    {
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            ++_stats.ping_number;
+        }
+
+        db_connection->ping();
+    }
+    catch (CDBException&)
+    {
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            ++_stats.ping_failure_number;
+        }
+
+        try
+        {
+            db_connection->reopen();
+        }
+        catch (CDBException&)
+        {
+            {
+                LockHelper<CLock> lock_helper(_lock);
+                ++_stats.open_failure_number;
+            }
+
+            release_connection(db_connection);
+            throw;
+        }
+    }
+}
+
+void CDBConnectionPool::release_connection(DBConnection* db_connection)
+{
+    db_connection->close();
+    delete db_connection;
+
+    LockHelper<CLock> lock_helper(_lock);
+    --_connection_number;
+    _event.signal();
+}
+
+SYS_NAMESPACE_END
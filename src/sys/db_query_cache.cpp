@@ -0,0 +1,126 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/db_query_cache.h"
+#include "sys/db_exception.h"
+#include "sys/mem_tracker.h"
+SYS_NAMESPACE_BEGIN
+
+static CMemTracker* get_mem_tracker()
+{
+    static CMemTracker* tracker = CMemTracker::get_tracker("db_result");
+    return tracker;
+}
+
+// 估算查询结果占用的内存，只计行和字段值，不计std::string的小字符串优化等
+static size_t get_table_bytes(const DBTable& table)
+{
+    size_t bytes = sizeof(DBTable) + table.capacity() * sizeof(DBRow);
+    for (DBTable::size_type i=0; i<table.size(); ++i)
+    {
+        bytes += table[i].capacity() * sizeof(std::string);
+        for (DBRow::size_type j=0; j<table[i].size(); ++j)
+            bytes += table[i][j].capacity();
+    }
+    return bytes;
+}
+
+// 结果在缓存和所有持有者都释放后才被删除，删除时从统计中减去
+struct TableDeleter
+{
+    size_t bytes;
+
+    TableDeleter(size_t bytes_): bytes(bytes_) {}
+
+    void operator ()(DBTable* table) const
+    {
+        get_mem_tracker()->release(bytes);
+        delete table;
+    }
+};
+
+// get_or_load的加载函数，在同一条SQL的第一个缺失者中调用
+struct CDBQueryCache::Loader
+{
+    CDBQueryCache* query_cache;
+
+    Loader(CDBQueryCache* query_cache_): query_cache(query_cache_) {}
+
+    bool operator ()(const std::string& sql, std::shared_ptr<const DBTable>* table) const
+    {
+        return query_cache->load(sql, table);
+    }
+};
+
+CDBQueryCache::CDBQueryCache(CDBConnectionPool* db_pool, const cache_policy_t& policy,
+                             const std::string& metrics_name, uint32_t borrow_milliseconds)
+    : _db_pool(db_pool), _borrow_milliseconds(borrow_milliseconds), _cache(policy, metrics_name)
+{
+}
+
+std::shared_ptr<const DBTable> CDBQueryCache::query(const std::string& sql, uint32_t ttl_milliseconds)
+{
+    std::shared_ptr<const DBTable> table;
+    if (!_cache.get_or_load(sql, Loader(this), &table, ttl_milliseconds))
+        THROW_DB_EXCEPTION(sql.c_str(), "shared query failed", DB_ERROR_SHARED_QUERY);
+    return table;
+}
+
+bool CDBQueryCache::invalidate(const std::string& sql)
+{
+    return _cache.remove(sql);
+}
+
+void CDBQueryCache::clear()
+{
+    _cache.clear();
+}
+
+bool CDBQueryCache::load(const std::string& sql, std::shared_ptr<const DBTable>* table)
+{
+    CDBConnectionPoolHelper db_connection(_db_pool, _borrow_milliseconds);
+    if (NULL == db_connection.get())
+        THROW_DB_EXCEPTION(sql.c_str(), "borrow db connection timeout", DB_ERROR_BORROW_TIMEOUT);
+
+    try
+    {
+        DBTable* result = new DBTable;
+        try
+        {
+            db_connection->query(*result, "%s", sql.c_str());
+        }
+        catch (...)
+        {
+            delete result;
+            throw;
+        }
+
+        const size_t bytes = get_table_bytes(*result);
+        get_mem_tracker()->allocate(bytes);
+        table->reset(result, TableDeleter(bytes));
+        return true;
+    }
+    catch (CDBException& db_error)
+    {
+        if (db_connection->is_lost_connection_exception(db_error))
+            db_connection.set_broken();
+        throw;
+    }
+}
+
+SYS_NAMESPACE_END
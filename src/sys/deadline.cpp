@@ -0,0 +1,93 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/deadline.h"
+#include "sys/clock.h"
+#include <limits>
+SYS_NAMESPACE_BEGIN
+
+// 本线程当前的截止时间，为0表示无限期
+static __thread uint64_t sg_deadline_nanoseconds = 0;
+
+CDeadline::CDeadline(uint32_t milliseconds)
+    : _nanoseconds(CClock::get_nanoseconds() + static_cast<uint64_t>(milliseconds)*1000000)
+{
+}
+
+CDeadline CDeadline::from_nanoseconds(uint64_t nanoseconds)
+{
+    CDeadline deadline;
+    deadline._nanoseconds = nanoseconds;
+    return deadline;
+}
+
+CDeadline CDeadline::earlier(const CDeadline& a, const CDeadline& b)
+{
+    if (a.is_infinite())
+        return b;
+    if (b.is_infinite())
+        return a;
+    return (a._nanoseconds < b._nanoseconds)? a: b;
+}
+
+CDeadline CDeadline::get_current()
+{
+    return from_nanoseconds(sg_deadline_nanoseconds);
+}
+
+bool CDeadline::is_expired() const
+{
+    return !is_infinite() && (CClock::get_nanoseconds() >= _nanoseconds);
+}
+
+int CDeadline::get_remaining_milliseconds() const
+{
+    if (is_infinite())
+        return -1;
+
+    const uint64_t now = CClock::get_nanoseconds();
+    if (now >= _nanoseconds)
+        return 0;
+
+    const uint64_t milliseconds = (_nanoseconds - now + 999999) / 1000000;
+    return (milliseconds > static_cast<uint64_t>(std::numeric_limits<int>::max()))? std::numeric_limits<int>::max(): static_cast<int>(milliseconds);
+}
+
+uint32_t CDeadline::clamp_milliseconds(uint32_t milliseconds) const
+{
+    if (is_infinite())
+        return milliseconds;
+
+    uint32_t remaining = static_cast<uint32_t>(get_remaining_milliseconds());
+    if (0 == remaining)
+        remaining = 1;
+    return ((0 == milliseconds) || (remaining < milliseconds))? remaining: milliseconds;
+}
+
+CDeadlineScope::CDeadlineScope(const CDeadline& deadline)
+    : _previous_nanoseconds(sg_deadline_nanoseconds)
+{
+    sg_deadline_nanoseconds = CDeadline::earlier(deadline, CDeadline::from_nanoseconds(_previous_nanoseconds)).get_nanoseconds();
+}
+
+CDeadlineScope::~CDeadlineScope()
+{
+    sg_deadline_nanoseconds = _previous_nanoseconds;
+}
+
+SYS_NAMESPACE_END
@@ -18,7 +18,13 @@
  */
 #include "sys/dir_utils.h"
 #include "sys/error.h"
+#include "sys/lock.h"
+#include "sys/thread_engine.h"
 #include "utils/string_utils.h"
+#include <deque>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -164,4 +170,204 @@ void CDirUtils::create_directory_byfilepath(const char* filepath, mode_t permiss
     create_directory_recursive(dirpath.c_str(),  permissions);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// getdents64返回的目录项，glibc 2.30之前没有定义
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct CDirWalker::WalkQueue
+{
+    CLock lock;
+    std::deque<std::string> dirpaths;
+};
+
+CDirWalker::CDirWalker(int num_threads, bool need_stat)
+    : _num_threads((num_threads < 1)? 1: num_threads), _need_stat(need_stat), _visitor(NULL),
+      _pending_number(0), _dir_number(0), _entry_number(0), _error_number(0)
+{
+    for (int i=0; i<_num_threads; ++i)
+        _queues.push_back(new WalkQueue);
+}
+
+CDirWalker::~CDirWalker()
+{
+    for (std::vector<WalkQueue*>::size_type i=0; i<_queues.size(); ++i)
+        delete _queues[i];
+}
+
+void CDirWalker::walk(const std::string& dirpath, IDirVisitor* visitor)
+{
+    const int fd = open(dirpath.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (-1 == fd)
+    {
+        const int errcode = errno;
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("open `%s` error: %s", dirpath.c_str(), Error::to_string(errcode).c_str()), errcode, "open");
+    }
+    close(fd);
+
+    _visitor = visitor;
+    _dir_number = 0;
+    _entry_number = 0;
+    _error_number = 0;
+    _pending_number = 1;
+    _queues[0]->dirpaths.push_back(dirpath);
+
+    std::vector<CThreadEngine*> thread_engines(_num_threads-1);
+    for (int i=1; i<_num_threads; ++i)
+        thread_engines[i-1] = new CThreadEngine(bind(&CDirWalker::work, this, i));
+    work(0);
+    for (std::vector<CThreadEngine*>::size_type i=0; i<thread_engines.size(); ++i)
+    {
+        thread_engines[i]->join();
+        delete thread_engines[i];
+    }
+}
+
+void CDirWalker::work(int index)
+{
+    static const size_t buffer_size = 256*1024; // 一次getdents64可取数千项
+    std::vector<char> buffer(buffer_size);
+    std::string dirpath;
+
+    for (;;)
+    {
+        if (!take_directory(index, &dirpath))
+        {
+            // 其它线程还在遍历的目录可能产生新的子目录
+            if (0 == __atomic_load_n(&_pending_number, __ATOMIC_ACQUIRE))
+                break;
+            sched_yield();
+            continue;
+        }
+
+        walk_directory(index, dirpath, &buffer[0], buffer_size);
+        __atomic_sub_fetch(&_pending_number, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+bool CDirWalker::take_directory(int index, std::string* dirpath)
+{
+    {
+        WalkQueue* queue = _queues[index];
+        LockHelper<CLock> lock_helper(queue->lock);
+        if (!queue->dirpaths.empty())
+        {
+            dirpath->swap(queue->dirpaths.back());
+            queue->dirpaths.pop_back();
+            return true;
+        }
+    }
+
+    // 从其它线程的队列头部窃取，头部的目录通常更靠近根，其下还有更多
+    for (int i=1; i<_num_threads; ++i)
+    {
+        WalkQueue* queue = _queues[(index+i) % _num_threads];
+        LockHelper<CLock> lock_helper(queue->lock);
+        if (!queue->dirpaths.empty())
+        {
+            dirpath->swap(queue->dirpaths.front());
+            queue->dirpaths.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CDirWalker::walk_directory(int index, const std::string& dirpath, char* buffer, size_t buffer_size)
+{
+    const int fd = open(dirpath.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+    if (-1 == fd)
+    {
+        __atomic_add_fetch(&_error_number, 1, __ATOMIC_RELAXED);
+        _visitor->on_error(dirpath, errno);
+        return;
+    }
+
+    const std::string prefix = (!dirpath.empty() && ('/' == dirpath[dirpath.size()-1]))? dirpath: dirpath + "/";
+    std::vector<std::string> subdirpaths;
+    dir_entry_t entry;
+    struct stat st;
+    entry.dirpath = &dirpath;
+    entry.dir_fd = fd;
+
+    for (;;)
+    {
+        const long n = syscall(SYS_getdents64, fd, buffer, buffer_size);
+        if (0 == n)
+            break;
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            __atomic_add_fetch(&_error_number, 1, __ATOMIC_RELAXED);
+            _visitor->on_error(dirpath, errno);
+            break;
+        }
+
+        for (long offset=0; offset<n;)
+        {
+            const struct linux_dirent64* ent = reinterpret_cast<const struct linux_dirent64*>(buffer + offset);
+            offset += ent->d_reclen;
+
+            // 排除当前目录和父目录
+            if (('.' == ent->d_name[0])
+             && (('\0' == ent->d_name[1]) || (('.' == ent->d_name[1]) && ('\0' == ent->d_name[2]))))
+                continue;
+
+            entry.name = ent->d_name;
+            entry.type = ent->d_type;
+            entry.st = NULL;
+            if (_need_stat || (DT_UNKNOWN == entry.type))
+            {
+                if (-1 == fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW))
+                    continue; // 已被删除
+                entry.st = &st;
+                entry.type = IFTODT(st.st_mode);
+            }
+
+            if (DT_DIR == entry.type)
+            {
+                __atomic_add_fetch(&_dir_number, 1, __ATOMIC_RELAXED);
+                if (_visitor->enter_directory(entry))
+                    subdirpaths.push_back(prefix + ent->d_name);
+
+                // 子目录很多时分批入队，其它线程不必等本目录读完
+                if (subdirpaths.size() >= 256)
+                    push_directories(index, &subdirpaths);
+            }
+            else
+            {
+                __atomic_add_fetch(&_entry_number, 1, __ATOMIC_RELAXED);
+                _visitor->on_entry(entry);
+            }
+        }
+    }
+    close(fd);
+
+    push_directories(index, &subdirpaths);
+}
+
+// 先计入待遍历数，再结束本目录，计数不会中途为0
+void CDirWalker::push_directories(int index, std::vector<std::string>* dirpaths)
+{
+    if (dirpaths->empty())
+        return;
+
+    __atomic_add_fetch(&_pending_number, static_cast<int64_t>(dirpaths->size()), __ATOMIC_ACQ_REL);
+    WalkQueue* queue = _queues[index];
+    LockHelper<CLock> lock_helper(queue->lock);
+    for (std::vector<std::string>::size_type i=0; i<dirpaths->size(); ++i)
+        queue->dirpaths.push_back(std::string());
+    for (std::vector<std::string>::size_type i=0; i<dirpaths->size(); ++i)
+        queue->dirpaths[queue->dirpaths.size()-dirpaths->size()+i].swap((*dirpaths)[i]);
+    dirpaths->clear();
+}
+
 SYS_NAMESPACE_END
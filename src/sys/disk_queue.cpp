@@ -0,0 +1,490 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/disk_queue.h"
+#include "sys/clock.h"
+#include "sys/dir_utils.h"
+#include "sys/syscall_exception.h"
+#include "utils/crc32.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+enum { RECORD_HEADER_SIZE = 8, SEQ_DIGITS = 20 };
+
+// 记录头加数据，按8字节对齐
+static uint32_t get_record_size(uint32_t size)
+{
+    return RECORD_HEADER_SIZE + ((size + 7) & ~7U);
+}
+
+static uint32_t load_uint32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// 文件名为20位的序号加后缀，不是时返回false
+static bool parse_seq(const std::string& filename, const char* suffix, uint64_t* seq)
+{
+    const size_t suffix_size = strlen(suffix);
+    if ((filename.size() != SEQ_DIGITS + suffix_size) || (filename.compare(SEQ_DIGITS, suffix_size, suffix) != 0))
+        return false;
+
+    *seq = 0;
+    for (int i=0; i<SEQ_DIGITS; ++i)
+    {
+        if ((filename[i] < '0') || (filename[i] > '9'))
+            return false;
+        *seq = *seq * 10 + (filename[i] - '0');
+    }
+    return true;
+}
+
+CDiskQueue::CDiskQueue()
+    : _next_seq(0), _offset_fd(-1), _offset_dirty(false),
+      _read_index(0), _read_offset(0), _record_number(0), _bytes(0),
+      _reserved(NULL), _reserved_size(0), _unsynced_records(0), _unsynced_bytes(0), _sync_milliseconds(0)
+{
+}
+
+CDiskQueue::~CDiskQueue()
+{
+    try
+    {
+        close();
+    }
+    catch (CSyscallException&)
+    {
+    }
+}
+
+void CDiskQueue::open(const std::string& directory, const CDiskQueuePolicy& policy)
+{
+    close();
+
+    const uint32_t page_size = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+    _policy = policy;
+    _policy.segment_size = (std::max<uint32_t>(policy.segment_size, page_size) + page_size - 1) / page_size * page_size;
+    CDirUtils::create_directory_recursive(directory.c_str());
+    _directory = directory;
+
+    try
+    {
+        std::vector<std::string> filenames;
+        std::vector<uint64_t> seqs;
+        CDirUtils::list(directory, NULL, &filenames);
+        for (std::vector<std::string>::size_type i=0; i<filenames.size(); ++i)
+        {
+            uint64_t seq;
+            if (parse_seq(filenames[i], ".dq", &seq))
+                seqs.push_back(seq);
+            else if (parse_seq(filenames[i], ".spare", &seq))
+                _spare_seqs.push_back(seq);
+            else
+                continue;
+            _next_seq = std::max(_next_seq, seq+1);
+        }
+
+        std::sort(seqs.begin(), seqs.end());
+        for (std::vector<uint64_t>::size_type i=0; i<seqs.size(); ++i)
+        {
+            struct Segment segment;
+            segment.seq = seqs[i];
+            segment.mmap = CMMap::map_both(get_segment_path(seqs[i]).c_str());
+            segment.end = 0;
+            segment.synced = 0;
+            _segments.push_back(segment);
+            if (NULL == segment.mmap->addr) // 空文件
+                continue;
+            recover_segment(&_segments.back());
+        }
+
+        const std::string offset_path = directory + "/offset";
+        _offset_fd = ::open(offset_path.c_str(), O_RDWR|O_CREAT, FILE_DEFAULT_PERM);
+        if (-1 == _offset_fd)
+            THROW_SYSCALL_EXCEPTION(offset_path, errno, "open");
+        load_offset();
+        recycle_segments();
+        _sync_milliseconds = CClock::get_milliseconds();
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+void CDiskQueue::close()
+{
+    if (_directory.empty())
+        return;
+
+    // 刷盘出错时也释放所有资源
+    _reserved = NULL;
+    try
+    {
+        sync();
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+    release();
+}
+
+void CDiskQueue::release()
+{
+    for (std::deque<struct Segment>::size_type i=0; i<_segments.size(); ++i)
+        CMMap::unmap(_segments[i].mmap);
+    _segments.clear();
+    _spare_seqs.clear();
+    if (_offset_fd != -1)
+        ::close(_offset_fd);
+    _offset_fd = -1;
+    _directory.clear();
+
+    _next_seq = 0;
+    _offset_dirty = false;
+    _read_index = 0;
+    _read_offset = 0;
+    _record_number = 0;
+    _bytes = 0;
+    _unsynced_records = 0;
+    _unsynced_bytes = 0;
+}
+
+char* CDiskQueue::reserve(uint32_t size)
+{
+    if (size > _policy.segment_size - RECORD_HEADER_SIZE)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("record size %u exceeds segment size %u", size, _policy.segment_size), EMSGSIZE);
+
+    const uint32_t record_size = get_record_size(size);
+    if (_segments.empty() || (_segments.back().mmap->len - _segments.back().end < record_size))
+    {
+        // 满时先回收已消费完的段
+        if ((_policy.max_segments > 0) && (_segments.size() >= _policy.max_segments) && (_read_index > 0))
+            sync();
+        if ((_policy.max_segments > 0) && (_segments.size() >= _policy.max_segments))
+            return NULL;
+        add_segment();
+    }
+
+    struct Segment& segment = _segments.back();
+    _reserved = static_cast<char*>(segment.mmap->addr) + segment.end + RECORD_HEADER_SIZE;
+    _reserved_size = size;
+    return _reserved;
+}
+
+void CDiskQueue::commit(uint32_t size)
+{
+    MOOON_ASSERT((_reserved != NULL) && (size <= _reserved_size));
+    struct Segment& segment = _segments.back();
+    char* header = _reserved - RECORD_HEADER_SIZE;
+    const uint32_t checksum = get_checksum(segment.seq, _reserved, size);
+
+    // 记录头在数据之后写入，崩溃时不完整的记录校验失败
+    memcpy(header, &size, sizeof(size));
+    memcpy(header+sizeof(size), &checksum, sizeof(checksum));
+    segment.end += get_record_size(size);
+    _reserved = NULL;
+    ++_record_number;
+    _bytes += size;
+
+    ++_unsynced_records;
+    _unsynced_bytes += get_record_size(size);
+    if (((_policy.sync_records > 0) && (_unsynced_records >= _policy.sync_records))
+     || ((_policy.sync_bytes > 0) && (_unsynced_bytes >= _policy.sync_bytes))
+     || ((_policy.sync_milliseconds > 0) && (CClock::get_milliseconds() - _sync_milliseconds >= _policy.sync_milliseconds)))
+        sync();
+}
+
+bool CDiskQueue::push(const void* data, uint32_t size)
+{
+    char* reserved = reserve(size);
+    if (NULL == reserved)
+        return false;
+
+    memcpy(reserved, data, size);
+    commit(size);
+    return true;
+}
+
+bool CDiskQueue::front(std::string_view* record)
+{
+    if (!locate_front())
+        return false;
+
+    const char* header = static_cast<const char*>(_segments[_read_index].mmap->addr) + _read_offset;
+    *record = std::string_view(header + RECORD_HEADER_SIZE, load_uint32(header));
+    return true;
+}
+
+size_t CDiskQueue::peek(std::vector<std::string_view>* records, size_t max_number)
+{
+    records->clear();
+    if (!locate_front())
+        return 0;
+
+    size_t index = _read_index;
+    uint32_t offset = _read_offset;
+    const size_t number = static_cast<size_t>(std::min<uint64_t>(max_number, _record_number));
+    while (records->size() < number)
+    {
+        if (offset >= _segments[index].end)
+        {
+            ++index;
+            offset = 0;
+            continue;
+        }
+
+        const char* header = static_cast<const char*>(_segments[index].mmap->addr) + offset;
+        const uint32_t size = load_uint32(header);
+        records->push_back(std::string_view(header + RECORD_HEADER_SIZE, size));
+        offset += get_record_size(size);
+    }
+    return records->size();
+}
+
+void CDiskQueue::pop(size_t number)
+{
+    for (size_t i=0; (i<number) && locate_front(); ++i)
+    {
+        const uint32_t size = load_uint32(static_cast<const char*>(_segments[_read_index].mmap->addr) + _read_offset);
+        _read_offset += get_record_size(size);
+        --_record_number;
+        _bytes -= size;
+        _offset_dirty = true;
+    }
+
+    // 读完的段立即跳过，刷盘时即可回收
+    if ((_read_index+1 < _segments.size()) && (_read_offset >= _segments[_read_index].end))
+    {
+        ++_read_index;
+        _read_offset = 0;
+    }
+    if ((_policy.sync_milliseconds > 0) && (CClock::get_milliseconds() - _sync_milliseconds >= _policy.sync_milliseconds))
+        sync();
+}
+
+void CDiskQueue::sync()
+{
+    for (std::deque<struct Segment>::size_type i=0; i<_segments.size(); ++i)
+        sync_segment(&_segments[i]);
+    if (_offset_dirty)
+        save_offset();
+    recycle_segments();
+
+    _unsynced_records = 0;
+    _unsynced_bytes = 0;
+    _sync_milliseconds = CClock::get_milliseconds();
+}
+
+std::string CDiskQueue::get_segment_path(uint64_t seq) const
+{
+    return utils::CStringUtils::format_string("%s/%020" PRIu64".dq", _directory.c_str(), seq);
+}
+
+std::string CDiskQueue::get_spare_path(uint64_t seq) const
+{
+    return utils::CStringUtils::format_string("%s/%020" PRIu64".spare", _directory.c_str(), seq);
+}
+
+void CDiskQueue::add_segment()
+{
+    const uint64_t seq = _next_seq++;
+    const std::string path = get_segment_path(seq);
+
+    if (!_spare_seqs.empty())
+    {
+        // 复用备用段，其中残留的记录因CRC含段序号而无效
+        const std::string spare_path = get_spare_path(_spare_seqs.back());
+        if (-1 == rename(spare_path.c_str(), path.c_str()))
+            THROW_SYSCALL_EXCEPTION(spare_path, errno, "rename");
+        _spare_seqs.pop_back();
+    }
+    else
+    {
+        const int fd = ::open(path.c_str(), O_RDWR|O_CREAT|O_EXCL, FILE_DEFAULT_PERM);
+        if (-1 == fd)
+            THROW_SYSCALL_EXCEPTION(path, errno, "open");
+
+        // 以posix_fallocate实际分配磁盘空间，磁盘满时在这里出错，而不是写映射区时收到SIGBUS
+        const int errcode = posix_fallocate(fd, 0, _policy.segment_size);
+        ::close(fd);
+        if (errcode != 0)
+        {
+            (void)unlink(path.c_str());
+            THROW_SYSCALL_EXCEPTION(path, errcode, "posix_fallocate");
+        }
+    }
+
+    struct Segment segment;
+    segment.seq = seq;
+    segment.mmap = CMMap::map_both(path.c_str());
+    segment.end = 0;
+    segment.synced = 0;
+    _segments.push_back(segment);
+}
+
+void CDiskQueue::recover_segment(struct Segment* segment)
+{
+    const char* data = static_cast<const char*>(segment->mmap->addr);
+    const uint32_t len = static_cast<uint32_t>(segment->mmap->len);
+    uint32_t offset = 0;
+
+    while (len - offset >= RECORD_HEADER_SIZE)
+    {
+        const uint32_t size = load_uint32(data + offset);
+        if ((size > len - offset - RECORD_HEADER_SIZE)
+         || (load_uint32(data + offset + sizeof(uint32_t)) != get_checksum(segment->seq, data + offset + RECORD_HEADER_SIZE, size)))
+            break;
+        offset += get_record_size(size);
+    }
+
+    segment->end = offset;
+    segment->synced = offset;
+}
+
+// offset文件：段序号（8字节）、段内偏移（8字节）和前16字节的CRC32C
+void CDiskQueue::load_offset()
+{
+    char buffer[20];
+    uint64_t seq = 0, offset = 0;
+    const bool valid = (pread(_offset_fd, buffer, sizeof(buffer), 0) == static_cast<ssize_t>(sizeof(buffer)))
+                    && (load_uint32(buffer+16) == utils::CCrc32::crc32c(buffer, 16));
+    if (valid)
+    {
+        memcpy(&seq, buffer, sizeof(seq));
+        memcpy(&offset, buffer+8, sizeof(offset));
+    }
+
+    // 消费位置所在的段不存在时，从其后的第一个段的开头读
+    _read_index = 0;
+    _read_offset = 0;
+    while ((_read_index < _segments.size()) && (_segments[_read_index].seq < seq))
+        ++_read_index;
+    if ((_read_index < _segments.size()) && (_segments[_read_index].seq == seq))
+        _read_offset = static_cast<uint32_t>(std::min<uint64_t>(offset, _segments[_read_index].end));
+    if ((_read_index == _segments.size()) && (_read_index > 0))
+    {
+        --_read_index;
+        _read_offset = _segments[_read_index].end;
+    }
+
+    _record_number = 0;
+    _bytes = 0;
+    for (size_t index=_read_index; index<_segments.size(); ++index)
+    {
+        const char* data = static_cast<const char*>(_segments[index].mmap->addr);
+        for (uint32_t pos=(index == _read_index)? _read_offset: 0; pos<_segments[index].end;)
+        {
+            const uint32_t size = load_uint32(data + pos);
+            ++_record_number;
+            _bytes += size;
+            pos += get_record_size(size);
+        }
+    }
+    _offset_dirty = false;
+}
+
+void CDiskQueue::save_offset()
+{
+    char buffer[20];
+    const uint64_t seq = _segments.empty()? _next_seq: _segments[_read_index].seq;
+    const uint64_t offset = _segments.empty()? 0: _read_offset;
+
+    memcpy(buffer, &seq, sizeof(seq));
+    memcpy(buffer+8, &offset, sizeof(offset));
+    const uint32_t checksum = utils::CCrc32::crc32c(buffer, 16);
+    memcpy(buffer+16, &checksum, sizeof(checksum));
+    if (pwrite(_offset_fd, buffer, sizeof(buffer), 0) != static_cast<ssize_t>(sizeof(buffer)))
+        THROW_SYSCALL_EXCEPTION(_directory + "/offset", errno, "pwrite");
+    if (-1 == fdatasync(_offset_fd))
+        THROW_SYSCALL_EXCEPTION(_directory + "/offset", errno, "fdatasync");
+    _offset_dirty = false;
+}
+
+// 回收读位置之前的段，须在消费位置写入磁盘之后
+void CDiskQueue::recycle_segments()
+{
+    while (_read_index > 0)
+    {
+        const struct Segment& segment = _segments.front();
+        const std::string path = get_segment_path(segment.seq);
+
+        CMMap::unmap(segment.mmap);
+        if (_spare_seqs.size() < _policy.spare_segments)
+        {
+            if (0 == rename(path.c_str(), get_spare_path(segment.seq).c_str()))
+                _spare_seqs.push_back(segment.seq);
+        }
+        else
+        {
+            (void)unlink(path.c_str());
+        }
+
+        _segments.pop_front();
+        --_read_index;
+    }
+}
+
+void CDiskQueue::sync_segment(struct Segment* segment)
+{
+    if (segment->synced >= segment->end)
+        return;
+
+    // msync要求地址页对齐
+    const uint32_t page_size = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+    const uint32_t aligned = segment->synced - segment->synced % page_size;
+    CMMap::sync_flush(segment->mmap, aligned, segment->end - aligned);
+    segment->synced = segment->end;
+}
+
+bool CDiskQueue::locate_front()
+{
+    if (0 == _record_number)
+        return false;
+
+    while (_read_offset >= _segments[_read_index].end)
+    {
+        ++_read_index;
+        _read_offset = 0;
+    }
+    return true;
+}
+
+uint32_t CDiskQueue::get_checksum(uint64_t seq, const char* data, uint32_t size)
+{
+    uint32_t crc = utils::CCrc32::crc32c(&seq, sizeof(seq));
+    crc = utils::CCrc32::crc32c(&size, sizeof(size), crc);
+    crc = utils::CCrc32::crc32c(data, size, crc);
+    return (0 == crc)? 1: crc; // 全0的区域总是无效
+}
+
+SYS_NAMESPACE_END
@@ -16,14 +16,27 @@
  *
  * Author: jian yi, eyjian@qq.com
  */
+#include <errno.h>
 #include <time.h>
-#include <sys/time.h>
 #include "sys/event.h"
 SYS_NAMESPACE_BEGIN
 
-CEvent::CEvent()
+CEvent::CEvent(bool use_monotonic_clock)
+    :_clock_id(CLOCK_REALTIME)
 {
-    int errcode = pthread_cond_init(&_cond, NULL);
+    int errcode;
+    pthread_condattr_t attr;
+
+    errcode = pthread_condattr_init(&attr);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_condattr_init");
+
+    // 不支持时仍按CLOCK_REALTIME计时
+    if (use_monotonic_clock && (0 == pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)))
+        _clock_id = CLOCK_MONOTONIC;
+
+    errcode = pthread_cond_init(&_cond, &attr);
+    pthread_condattr_destroy(&attr);
     if (errcode != 0)
         THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_cond_init");
 }
@@ -52,22 +65,12 @@ bool CEvent::timed_wait(CLock& lock, uint32_t millisecond)
 	{
 		struct timespec abstime;
 
-#if _POSIX_C_SOURCE >= 199309L
-        if (-1 == clock_gettime(CLOCK_REALTIME, &abstime))
+        // 须和条件变量所用的时钟一致
+        if (-1 == clock_gettime(_clock_id, &abstime))
             THROW_SYSCALL_EXCEPTION(NULL, errno, "clock_gettime");
 
         abstime.tv_sec  += millisecond / 1000;
         abstime.tv_nsec += (millisecond % 1000) * 1000000;
-#else
-        struct timeval tv;
-        if (-1 == gettimeofday(&tv, NULL))
-            THROW_SYSCALL_EXCEPTION(NULL, errno, "gettimeofday");
-
-        abstime.tv_sec = tv.tv_sec;
-        abstime.tv_nsec = tv.tv_usec * 1000;
-        abstime.tv_sec  += millisecond / 1000;
-        abstime.tv_nsec += (millisecond % 1000) * 1000000;
-#endif // _POSIX_C_SOURCE
         
         // 处理tv_nsec溢出
         if (abstime.tv_nsec >= 1000000000L)
@@ -99,4 +102,11 @@ void CEvent::broadcast()
         THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_cond_broadcast");
 }
 
+void CEvent::wake_n(uint32_t n)
+{
+    // 条件变量不能指定唤醒的个数，逐个signal，没有等待者时signal不进入内核
+    for (uint32_t i=0; i<n; ++i)
+        signal();
+}
+
 SYS_NAMESPACE_END
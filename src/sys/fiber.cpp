@@ -0,0 +1,840 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/fiber.h"
+#include "sys/log.h"
+#include <deque>
+#include <map>
+#include <poll.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 纤程状态
+#define FIBER_READY    0
+#define FIBER_RUNNING  1
+#define FIBER_WAITING  2
+#define FIBER_FINISHED 3
+
+// 等待字的低2位，高位为等待序号，每次等待加一，
+// 唤醒者（事件、定时器或另一线程）以CAS将WAITING改为WOKEN，只有一方能成功，
+// 序号使过期的定时器不会唤醒同一纤程之后的等待
+#define WAIT_WAITING 1
+#define WAIT_WOKEN   2
+
+// 载体线程连续运行多少个纤程后，检查一次I/O事件和定时器
+#define FIBER_POLL_INTERVAL 64
+
+// 空闲时epoll_wait的最长等待毫秒数
+#define CARRIER_IDLE_MILLISECONDS 100
+
+typedef std::multimap<uint64_t, std::pair<CFiber*, uint64_t> > fiber_timers_t;
+
+class CFiber
+{
+public:
+    CFiber(CFiberScheduler* scheduler_)
+        : scheduler(scheduler_), stack(NULL), carrier(NULL), state(FIBER_READY)
+        , wait_word(0), timed_out(false), has_timer(false), wait_fd(-1), revents(0)
+        , wait_queue(NULL), prev(NULL), next(NULL)
+    {
+    }
+
+public:
+    CFiberScheduler* scheduler;
+    char* stack;            /** 含警戒页的栈，为NULL表示没有缓存的栈 */
+    ucontext_t context;
+    Functor functor;
+    CFiberCarrier* carrier; /** 正在或最近一次运行它的载体线程 */
+    int state;
+
+public: // 等待相关
+    uint64_t wait_word;
+    bool timed_out;
+    bool has_timer;
+    fiber_timers_t::iterator timer;
+    int wait_fd;
+    uint32_t revents;
+    CFiberWaitQueue* wait_queue;
+    CFiber* prev;
+    CFiber* next;
+};
+
+class CFiberCarrier
+{
+public:
+    CFiberCarrier(CFiberScheduler* scheduler_, uint16_t index_);
+    ~CFiberCarrier();
+
+    void run();
+    void run_fiber(CFiber* fiber);
+    CFiber* pop_front();
+    CFiber* pop_back();
+    void push_back(CFiber* fiber);
+    void wakeup();
+    void add_timer(CFiber* fiber, uint32_t milliseconds);
+    void poll_events(int milliseconds);
+
+private:
+    int get_poll_milliseconds() const;
+    void run_timers();
+
+public:
+    CFiberScheduler* scheduler;
+    uint16_t index;
+    ucontext_t context;
+    CFiber* current;
+    void (*after_switch)(void*); /** 纤程挂起后在载体线程中调用，如释放等待队列的锁 */
+    void* after_switch_arg;
+    volatile bool sleeping;
+    uint64_t switch_number;
+    uint64_t steal_number;
+    int epoll_fd;
+    int event_fd;
+    CThreadEngine* thread;
+
+private:
+    CAdaptiveLock _queue_lock;
+    std::deque<CFiber*> _run_queue;
+    fiber_timers_t _timers; // 只被本载体线程访问
+};
+
+static __thread CFiberCarrier* sg_carrier = NULL;
+
+static uint64_t get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 不内联，切换后可能已在另一个载体线程上，避免编译器复用切换前取得的线程局部变量地址
+static __attribute__((noinline)) CFiber* get_current_fiber()
+{
+    CFiberCarrier* carrier = sg_carrier;
+    return (NULL == carrier)? NULL: carrier->current;
+}
+
+static uint64_t begin_wait(CFiber* fiber)
+{
+    const uint64_t wait_word = (((fiber->wait_word >> 2) + 1) << 2) | WAIT_WAITING;
+    fiber->timed_out = false;
+    fiber->has_timer = false; // 之前的等待被其它线程唤醒时，定时器可能还在，但已过期
+    fiber->revents = 0;
+    __atomic_store_n(&fiber->wait_word, wait_word, __ATOMIC_RELEASE);
+    return wait_word;
+}
+
+static bool try_wake(CFiber* fiber, uint64_t wait_word)
+{
+    return __atomic_compare_exchange_n(&fiber->wait_word, &wait_word, (wait_word & ~static_cast<uint64_t>(3)) | WAIT_WOKEN, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// 挂起当前纤程，返回时可能已在另一个载体线程上
+static void switch_to_carrier(CFiber* fiber, int state, void (*after_switch)(void*)=NULL, void* after_switch_arg=NULL)
+{
+    CFiberCarrier* carrier = fiber->carrier;
+    fiber->state = state;
+    carrier->after_switch = after_switch;
+    carrier->after_switch_arg = after_switch_arg;
+    (void)swapcontext(&fiber->context, &carrier->context);
+}
+
+static void unlock_adaptive_lock(void* arg)
+{
+    static_cast<CAdaptiveLock*>(arg)->unlock();
+}
+
+static void fiber_main()
+{
+    CFiber* fiber = get_current_fiber();
+
+    try
+    {
+        fiber->functor();
+    }
+    catch (CSyscallException& ex)
+    {
+        MYLOG_ERROR("fiber error: %s\n", ex.str().c_str());
+    }
+    catch (std::exception& ex)
+    {
+        MYLOG_ERROR("fiber exception: %s\n", ex.what());
+    }
+
+    switch_to_carrier(fiber, FIBER_FINISHED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CFiberCarrier::CFiberCarrier(CFiberScheduler* scheduler_, uint16_t index_)
+    : scheduler(scheduler_), index(index_), current(NULL), after_switch(NULL), after_switch_arg(NULL)
+    , sleeping(false), switch_number(0), steal_number(0), epoll_fd(-1), event_fd(-1), thread(NULL)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == epoll_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "epoll_create1");
+
+    event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (-1 == event_fd)
+    {
+        const int errcode = errno;
+        ::close(epoll_fd);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "eventfd");
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event))
+    {
+        const int errcode = errno;
+        ::close(event_fd);
+        ::close(epoll_fd);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "epoll_ctl");
+    }
+}
+
+CFiberCarrier::~CFiberCarrier()
+{
+    ::close(event_fd);
+    ::close(epoll_fd);
+}
+
+void CFiberCarrier::run()
+{
+    uint32_t run_number = 0;
+    sg_carrier = this;
+
+    for (;;)
+    {
+        CFiber* fiber = pop_front();
+        if (NULL == fiber)
+        {
+            fiber = scheduler->steal(this);
+            if (fiber != NULL)
+                ++steal_number;
+        }
+        if (fiber != NULL)
+        {
+            run_fiber(fiber);
+            // 一直有就绪的纤程时，也要定期检查I/O事件和定时器
+            if (0 == ++run_number % FIBER_POLL_INTERVAL)
+                poll_events(0);
+            continue;
+        }
+        if (__atomic_load_n(&scheduler->_stop, __ATOMIC_ACQUIRE) && (0 == scheduler->get_fiber_number()))
+            break;
+
+        // 先标记为睡眠再检查队列，push在放入队列后检查标记，两者之一总能看到对方
+        __atomic_store_n(&sleeping, true, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&scheduler->_idle_number, 1, __ATOMIC_SEQ_CST);
+        _queue_lock.lock();
+        const bool empty = _run_queue.empty();
+        _queue_lock.unlock();
+        poll_events(empty? get_poll_milliseconds(): 0);
+        __atomic_sub_fetch(&scheduler->_idle_number, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&sleeping, false, __ATOMIC_RELAXED);
+    }
+
+    sg_carrier = NULL;
+}
+
+void CFiberCarrier::run_fiber(CFiber* fiber)
+{
+    fiber->carrier = this;
+    fiber->state = FIBER_RUNNING;
+    current = fiber;
+    ++switch_number;
+    (void)swapcontext(&context, &fiber->context);
+    current = NULL;
+
+    // 必须在after_switch之前取状态，释放锁后纤程可能已被唤醒并在其它载体线程上运行
+    const int state = fiber->state;
+    if (after_switch != NULL)
+    {
+        (*after_switch)(after_switch_arg);
+        after_switch = NULL;
+    }
+
+    if (FIBER_READY == state)
+        scheduler->push(this, fiber);
+    else if (FIBER_FINISHED == state)
+        scheduler->on_fiber_finished(fiber);
+}
+
+CFiber* CFiberCarrier::pop_front()
+{
+    CFiber* fiber = NULL;
+    LockHelper<CAdaptiveLock> lock_helper(_queue_lock);
+    if (!_run_queue.empty())
+    {
+        fiber = _run_queue.front();
+        _run_queue.pop_front();
+    }
+    return fiber;
+}
+
+CFiber* CFiberCarrier::pop_back()
+{
+    CFiber* fiber = NULL;
+    LockHelper<CAdaptiveLock> lock_helper(_queue_lock);
+    if (!_run_queue.empty())
+    {
+        fiber = _run_queue.back();
+        _run_queue.pop_back();
+    }
+    return fiber;
+}
+
+void CFiberCarrier::push_back(CFiber* fiber)
+{
+    LockHelper<CAdaptiveLock> lock_helper(_queue_lock);
+    _run_queue.push_back(fiber);
+}
+
+void CFiberCarrier::wakeup()
+{
+    const uint64_t value = 1;
+    while ((-1 == write(event_fd, &value, sizeof(value))) && (EINTR == errno));
+}
+
+void CFiberCarrier::add_timer(CFiber* fiber, uint32_t milliseconds)
+{
+    fiber->timer = _timers.insert(std::make_pair(get_monotonic_milliseconds() + milliseconds, std::make_pair(fiber, fiber->wait_word)));
+    fiber->has_timer = true;
+}
+
+int CFiberCarrier::get_poll_milliseconds() const
+{
+    if (_timers.empty())
+        return CARRIER_IDLE_MILLISECONDS;
+
+    const uint64_t now = get_monotonic_milliseconds();
+    const uint64_t expire = _timers.begin()->first;
+    if (expire <= now)
+        return 0;
+    return (expire - now < CARRIER_IDLE_MILLISECONDS)? static_cast<int>(expire - now): CARRIER_IDLE_MILLISECONDS;
+}
+
+void CFiberCarrier::poll_events(int milliseconds)
+{
+    struct epoll_event events[64];
+    const int n = epoll_wait(epoll_fd, events, sizeof(events)/sizeof(events[0]), milliseconds);
+
+    for (int i=0; i<n; ++i)
+    {
+        CFiber* fiber = static_cast<CFiber*>(events[i].data.ptr);
+        if (NULL == fiber)
+        {
+            uint64_t value;
+            (void)read(event_fd, &value, sizeof(value));
+            continue;
+        }
+
+        // 等待I/O的纤程只会被本载体线程唤醒（事件或定时器），不需要CAS之外的同步
+        if (try_wake(fiber, __atomic_load_n(&fiber->wait_word, __ATOMIC_ACQUIRE)))
+        {
+            (void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fiber->wait_fd, NULL);
+            fiber->revents = events[i].events;
+            if (fiber->has_timer)
+            {
+                _timers.erase(fiber->timer);
+                fiber->has_timer = false;
+            }
+            scheduler->push(this, fiber);
+        }
+    }
+
+    run_timers();
+}
+
+void CFiberCarrier::run_timers()
+{
+    const uint64_t now = get_monotonic_milliseconds();
+
+    while (!_timers.empty() && (_timers.begin()->first <= now))
+    {
+        CFiber* fiber = _timers.begin()->second.first;
+        const uint64_t wait_word = _timers.begin()->second.second;
+        _timers.erase(_timers.begin());
+
+        // 失败表示已被其它方式唤醒，这是一个过期的定时器
+        if (try_wake(fiber, wait_word))
+        {
+            fiber->has_timer = false;
+            fiber->timed_out = true;
+            if (fiber->wait_fd != -1)
+                (void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fiber->wait_fd, NULL);
+            if (fiber->wait_queue != NULL)
+                fiber->wait_queue->remove(fiber);
+            scheduler->push(this, fiber);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CFiberScheduler::CFiberScheduler()
+    : _page_size(0), _stack_size(0), _max_cached_stacks(0), _cached_stack_number(0)
+    , _fiber_number(0), _next_carrier(0), _idle_number(0), _stop(false)
+    , _switch_number(0), _steal_number(0)
+{
+}
+
+CFiberScheduler::~CFiberScheduler()
+{
+    destroy();
+}
+
+void CFiberScheduler::create(uint16_t carrier_number, size_t stack_size, uint32_t max_cached_stacks)
+{
+    if (0 == carrier_number)
+    {
+        const long cpu_number = sysconf(_SC_NPROCESSORS_ONLN);
+        carrier_number = (cpu_number > 0)? static_cast<uint16_t>(cpu_number): 1;
+    }
+
+    _page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    _stack_size = (stack_size + _page_size - 1) / _page_size * _page_size;
+    _max_cached_stacks = max_cached_stacks;
+    _stop = false;
+
+    try
+    {
+        for (uint16_t i=0; i<carrier_number; ++i)
+            _carriers.push_back(new CFiberCarrier(this, i));
+        for (uint16_t i=0; i<carrier_number; ++i)
+            _carriers[i]->thread = new CThreadEngine(bind(&CFiberCarrier::run, _carriers[i]));
+    }
+    catch (CSyscallException& ex)
+    {
+        destroy();
+        throw;
+    }
+}
+
+void CFiberScheduler::destroy()
+{
+    __atomic_store_n(&_stop, true, __ATOMIC_RELEASE);
+    wakeup_all();
+
+    for (std::vector<CFiberCarrier*>::size_type i=0; i<_carriers.size(); ++i)
+    {
+        if (_carriers[i]->thread != NULL)
+        {
+            _carriers[i]->thread->join();
+            delete _carriers[i]->thread;
+        }
+        _switch_number += _carriers[i]->switch_number;
+        _steal_number += _carriers[i]->steal_number;
+        delete _carriers[i];
+    }
+    _carriers.clear();
+
+    for (std::vector<CFiber*>::size_type i=0; i<_all_fibers.size(); ++i)
+    {
+        if (_all_fibers[i]->stack != NULL)
+            (void)munmap(_all_fibers[i]->stack, _page_size + _stack_size);
+        delete _all_fibers[i];
+    }
+    _all_fibers.clear();
+    _free_fibers.clear();
+    _cached_stack_number = 0;
+}
+
+void CFiberScheduler::spawn(const Functor& functor)
+{
+    CFiber* fiber = allocate_fiber();
+
+    // 每次从头开始运行fiber_main
+    (void)getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = fiber->stack + _page_size;
+    fiber->context.uc_stack.ss_size = _stack_size;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, fiber_main, 0);
+    fiber->functor = functor;
+    fiber->state = FIBER_READY;
+
+    CFiber* current = get_current_fiber();
+    if ((current != NULL) && (current->scheduler == this))
+        fiber->carrier = current->carrier;
+    else
+        fiber->carrier = _carriers[__atomic_fetch_add(&_next_carrier, 1, __ATOMIC_RELAXED) % _carriers.size()];
+    __atomic_add_fetch(&_fiber_number, 1, __ATOMIC_ACQ_REL);
+    push(fiber->carrier, fiber);
+}
+
+uint64_t CFiberScheduler::get_switch_number() const
+{
+    uint64_t switch_number = _switch_number;
+    for (std::vector<CFiberCarrier*>::size_type i=0; i<_carriers.size(); ++i)
+        switch_number += __atomic_load_n(&_carriers[i]->switch_number, __ATOMIC_RELAXED);
+    return switch_number;
+}
+
+uint64_t CFiberScheduler::get_steal_number() const
+{
+    uint64_t steal_number = _steal_number;
+    for (std::vector<CFiberCarrier*>::size_type i=0; i<_carriers.size(); ++i)
+        steal_number += __atomic_load_n(&_carriers[i]->steal_number, __ATOMIC_RELAXED);
+    return steal_number;
+}
+
+bool CFiberScheduler::in_fiber()
+{
+    return get_current_fiber() != NULL;
+}
+
+void CFiberScheduler::yield()
+{
+    CFiber* fiber = get_current_fiber();
+    if (NULL == fiber)
+        (void)sched_yield();
+    else
+        switch_to_carrier(fiber, FIBER_READY);
+}
+
+void CFiberScheduler::sleep(uint32_t milliseconds)
+{
+    CFiber* fiber = get_current_fiber();
+    if (NULL == fiber)
+    {
+        struct timespec ts = { milliseconds / 1000, (milliseconds % 1000) * 1000000 };
+        while ((-1 == nanosleep(&ts, &ts)) && (EINTR == errno));
+    }
+    else if (0 == milliseconds)
+    {
+        switch_to_carrier(fiber, FIBER_READY);
+    }
+    else
+    {
+        (void)begin_wait(fiber);
+        fiber->carrier->add_timer(fiber, milliseconds);
+        switch_to_carrier(fiber, FIBER_WAITING);
+    }
+}
+
+bool CFiberScheduler::poll(int fd, int events, int milliseconds, int* revents)
+{
+    CFiber* fiber = get_current_fiber();
+
+    // 不在纤程中，或只是检查一下
+    if ((NULL == fiber) || (0 == milliseconds))
+    {
+        struct pollfd fds = { fd, static_cast<short>(events), 0 };
+        int retval;
+        while ((-1 == (retval = ::poll(&fds, 1, milliseconds))) && (EINTR == errno));
+        if (-1 == retval)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "poll");
+        if (revents != NULL)
+            *revents = fds.revents;
+        return retval > 0;
+    }
+
+    // POLLIN等与EPOLLIN等的值相同
+    const uint64_t wait_word = begin_wait(fiber);
+    struct epoll_event event;
+    event.events = static_cast<uint32_t>(events) | EPOLLONESHOT;
+    event.data.ptr = fiber;
+    if (-1 == epoll_ctl(fiber->carrier->epoll_fd, EPOLL_CTL_ADD, fd, &event))
+    {
+        // 普通文件不支持epoll，同poll总是就绪
+        if (errno != EPERM)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "epoll_ctl");
+        (void)try_wake(fiber, wait_word);
+        if (revents != NULL)
+            *revents = events & (POLLIN|POLLOUT);
+        return true;
+    }
+
+    fiber->wait_fd = fd;
+    if (milliseconds > 0)
+        fiber->carrier->add_timer(fiber, static_cast<uint32_t>(milliseconds));
+    switch_to_carrier(fiber, FIBER_WAITING);
+    fiber->wait_fd = -1;
+
+    if (fiber->timed_out)
+        return false;
+    if (revents != NULL)
+        *revents = static_cast<int>(fiber->revents);
+    return true;
+}
+
+CFiber* CFiberScheduler::allocate_fiber()
+{
+    CFiber* fiber = NULL;
+
+    {
+        LockHelper<CLock> lock_helper(_free_lock);
+        if (!_free_fibers.empty())
+        {
+            fiber = _free_fibers.back();
+            _free_fibers.pop_back();
+            if (fiber->stack != NULL)
+                --_cached_stack_number;
+        }
+        else
+        {
+            fiber = new CFiber(this);
+            _all_fibers.push_back(fiber);
+        }
+    }
+
+    if (NULL == fiber->stack)
+    {
+        // 栈从高地址向低地址增长，警戒页在最低处
+        void* stack = mmap(NULL, _page_size + _stack_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_STACK, -1, 0);
+        if (MAP_FAILED == stack)
+        {
+            const int errcode = errno;
+            free_fiber(fiber);
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+        }
+        if (-1 == mprotect(stack, _page_size, PROT_NONE))
+        {
+            const int errcode = errno;
+            (void)munmap(stack, _page_size + _stack_size);
+            free_fiber(fiber);
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "mprotect");
+        }
+
+        fiber->stack = static_cast<char*>(stack);
+    }
+
+    return fiber;
+}
+
+void CFiberScheduler::free_fiber(CFiber* fiber)
+{
+    fiber->functor = Functor();
+
+    LockHelper<CLock> lock_helper(_free_lock);
+    if (fiber->stack != NULL)
+    {
+        if (_cached_stack_number < _max_cached_stacks)
+        {
+            ++_cached_stack_number;
+        }
+        else
+        {
+            (void)munmap(fiber->stack, _page_size + _stack_size);
+            fiber->stack = NULL;
+        }
+    }
+    _free_fibers.push_back(fiber);
+}
+
+void CFiberScheduler::schedule(CFiber* fiber)
+{
+    push(fiber->carrier, fiber);
+}
+
+void CFiberScheduler::push(CFiberCarrier* carrier, CFiber* fiber)
+{
+    carrier->push_back(fiber);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&carrier->sleeping, __ATOMIC_RELAXED))
+    {
+        if (sg_carrier != carrier)
+            carrier->wakeup();
+    }
+    else if (__atomic_load_n(&_idle_number, __ATOMIC_RELAXED) > 0)
+    {
+        // 唤醒一个空闲的载体线程来窃取
+        for (std::vector<CFiberCarrier*>::size_type i=0; i<_carriers.size(); ++i)
+        {
+            if ((_carriers[i] != carrier) && __atomic_load_n(&_carriers[i]->sleeping, __ATOMIC_RELAXED))
+            {
+                _carriers[i]->wakeup();
+                break;
+            }
+        }
+    }
+}
+
+CFiber* CFiberScheduler::steal(CFiberCarrier* thief)
+{
+    const std::vector<CFiberCarrier*>::size_type carrier_number = _carriers.size();
+    for (std::vector<CFiberCarrier*>::size_type i=1; i<carrier_number; ++i)
+    {
+        CFiber* fiber = _carriers[(thief->index + i) % carrier_number]->pop_back();
+        if (fiber != NULL)
+            return fiber;
+    }
+
+    return NULL;
+}
+
+void CFiberScheduler::on_fiber_finished(CFiber* fiber)
+{
+    free_fiber(fiber);
+    if ((0 == __atomic_sub_fetch(&_fiber_number, 1, __ATOMIC_ACQ_REL)) && __atomic_load_n(&_stop, __ATOMIC_ACQUIRE))
+        wakeup_all();
+}
+
+void CFiberScheduler::wakeup_all()
+{
+    for (std::vector<CFiberCarrier*>::size_type i=0; i<_carriers.size(); ++i)
+        _carriers[i]->wakeup();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool CFiberWaitQueue::park(uint32_t milliseconds)
+{
+    CFiber* fiber = get_current_fiber();
+    if (NULL == fiber)
+    {
+        _lock.unlock();
+        THROW_SYSCALL_EXCEPTION("not in fiber", EPERM, "park");
+    }
+
+    (void)begin_wait(fiber);
+    fiber->wait_queue = this;
+    fiber->prev = _tail;
+    fiber->next = NULL;
+    if (NULL == _tail)
+        _head = fiber;
+    else
+        _tail->next = fiber;
+    _tail = fiber;
+
+    if (milliseconds > 0)
+        fiber->carrier->add_timer(fiber, milliseconds);
+    switch_to_carrier(fiber, FIBER_WAITING, unlock_adaptive_lock, &_lock);
+    fiber->wait_queue = NULL;
+    return !fiber->timed_out;
+}
+
+bool CFiberWaitQueue::wake_one()
+{
+    while (_head != NULL)
+    {
+        CFiber* fiber = _head;
+        _head = fiber->next;
+        if (NULL == _head)
+            _tail = NULL;
+        else
+            _head->prev = NULL;
+        fiber->prev = NULL;
+        fiber->next = NULL;
+
+        // 失败表示正在超时，它的定时器会调用remove，这时它已不在队列中
+        if (try_wake(fiber, __atomic_load_n(&fiber->wait_word, __ATOMIC_ACQUIRE)))
+        {
+            fiber->scheduler->schedule(fiber);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CFiberWaitQueue::wake_all()
+{
+    while (wake_one());
+}
+
+void CFiberWaitQueue::remove(CFiber* fiber)
+{
+    LockHelper<CAdaptiveLock> lock_helper(_lock);
+    if ((fiber->prev != NULL) || (_head == fiber))
+    {
+        if (fiber->prev != NULL)
+            fiber->prev->next = fiber->next;
+        else
+            _head = fiber->next;
+        if (fiber->next != NULL)
+            fiber->next->prev = fiber->prev;
+        else
+            _tail = fiber->prev;
+        fiber->prev = NULL;
+        fiber->next = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void CFiberLock::lock()
+{
+    if (try_lock())
+        return;
+
+    if (!CFiberScheduler::in_fiber())
+    {
+        while (!try_lock())
+            (void)sched_yield();
+        return;
+    }
+
+    _waiters._lock.lock();
+    // 持有队列锁再试一次，unlock也在队列锁下检查等待者，所以不会错过
+    if (0 == __atomic_exchange_n(&_locked, 1, __ATOMIC_ACQUIRE))
+    {
+        _waiters._lock.unlock();
+        return;
+    }
+
+    // 被唤醒时锁已由unlock直接移交
+    (void)_waiters.park(0);
+}
+
+void CFiberLock::unlock()
+{
+    LockHelper<CAdaptiveLock> lock_helper(_waiters._lock);
+    if (!_waiters.wake_one())
+        __atomic_store_n(&_locked, 0, __ATOMIC_RELEASE);
+}
+
+bool CFiberLock::try_lock()
+{
+    int expected = 0;
+    return __atomic_compare_exchange_n(&_locked, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void CFiberEvent::wait(CFiberLock& lock)
+{
+    (void)timed_wait(lock, 0);
+}
+
+bool CFiberEvent::timed_wait(CFiberLock& lock, uint32_t milliseconds)
+{
+    _waiters._lock.lock();
+    lock.unlock();
+    const bool signaled = _waiters.park(milliseconds);
+    lock.lock();
+    return signaled;
+}
+
+void CFiberEvent::signal()
+{
+    LockHelper<CAdaptiveLock> lock_helper(_waiters._lock);
+    (void)_waiters.wake_one();
+}
+
+void CFiberEvent::broadcast()
+{
+    LockHelper<CAdaptiveLock> lock_helper(_waiters._lock);
+    _waiters.wake_all();
+}
+
+SYS_NAMESPACE_END
@@ -16,25 +16,33 @@
  *
  * Author: jian yi, eyjian@qq.com
  */
-#include <zlib.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <linux/fs.h>
 #include "sys/file_utils.h"
+#include "sys/atomic.h"
 #include "sys/close_helper.h"
+#include "sys/thread_engine.h"
+#include "utils/crc32.h"
 #include "utils/md5_helper.h"
+#include "utils/scoped_ptr.h"
 #include "utils/string_utils.h"
 SYS_NAMESPACE_BEGIN
 
 bool CFileUtils::md5sum(std::string* md5_str, int fd, const char* filepath)
 {
+    static const size_t buffer_size = 1024*1024;
     utils::CMd5Helper md5;
-    char line[mooon::SIZE_4K];
+    utils::ScopedArray<char> buffer(new char[buffer_size]);
     ssize_t file_size = 0;
 
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
     while (true)
     {
-        const ssize_t n = read(fd, line, sizeof(line));
+        const ssize_t n = read(fd, buffer.get(), buffer_size);
 
         if (0 == n)
         {
@@ -42,6 +50,8 @@ bool CFileUtils::md5sum(std::string* md5_str, int fd, const char* filepath)
         }
         else if (-1 == n)
         {
+            if (EINTR == errno)
+                continue;
             if (NULL == filepath)
                 THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
             else
@@ -53,9 +63,7 @@ bool CFileUtils::md5sum(std::string* md5_str, int fd, const char* filepath)
         else
         {
             file_size += n;
-            md5.update(line, n);
-            if (n < static_cast<ssize_t>(sizeof(line)))
-                break;
+            md5.update(buffer.get(), n);
         }
     }
 
@@ -63,6 +71,113 @@ bool CFileUtils::md5sum(std::string* md5_str, int fd, const char* filepath)
     return file_size > 0;
 }
 
+// 求[offset, offset+size)的MD5，出错返回errno
+static int md5_range(int fd, off_t offset, size_t size, char* buffer, size_t buffer_size, unsigned char digest[16])
+{
+    utils::CMd5Helper md5;
+    while (size > 0)
+    {
+        const ssize_t n = pread(fd, buffer, std::min(size, buffer_size), offset);
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            return errno;
+        }
+        if (0 == n)
+            return EIO; // 文件被截断
+
+        md5.update(buffer, n);
+        offset += n;
+        size -= n;
+    }
+
+    md5.to_bytes(digest);
+    return 0;
+}
+
+struct TreeMd5Context
+{
+    int fd;
+    off_t file_size;
+    size_t chunk_size;
+    size_t chunk_number;
+    volatile int errcode;
+    std::vector<unsigned char> digests; // 依次为各块的MD5
+};
+
+// 第index个线程处理第index、index+num_threads、...个块
+static void tree_md5_worker(TreeMd5Context* context, size_t index, size_t num_threads)
+{
+    static const size_t buffer_size = 1024*1024;
+    utils::ScopedArray<char> buffer(new char[buffer_size]);
+
+    for (size_t chunk=index; (chunk<context->chunk_number) && (0 == context->errcode); chunk+=num_threads)
+    {
+        const off_t offset = static_cast<off_t>(chunk * context->chunk_size);
+        const size_t size = std::min(context->chunk_size, static_cast<size_t>(context->file_size - offset));
+        const int errcode = md5_range(context->fd, offset, size, buffer.get(), buffer_size, &context->digests[chunk*16]);
+        if (errcode != 0)
+            context->errcode = errcode;
+    }
+}
+
+bool CFileUtils::tree_md5sum(std::string* md5_str, int fd, size_t chunk_size, int num_threads, const char* filepath)
+{
+    TreeMd5Context context;
+    context.fd = fd;
+    context.file_size = get_file_size(fd);
+    context.chunk_size = (0 == chunk_size)? 1: chunk_size;
+    context.chunk_number = (context.file_size + context.chunk_size - 1) / context.chunk_size;
+    context.errcode = 0;
+    context.digests.resize(context.chunk_number * 16);
+    if (0 == context.file_size)
+    {
+        *md5_str = utils::CMd5Helper::md5("%s", "");
+        return false;
+    }
+
+    const size_t thread_number = std::max<size_t>(1, std::min<size_t>(num_threads, context.chunk_number));
+    std::vector<CThreadEngine*> thread_engines(thread_number-1);
+    for (size_t i=1; i<thread_number; ++i)
+        thread_engines[i-1] = new CThreadEngine(bind(&tree_md5_worker, &context, i, thread_number));
+    tree_md5_worker(&context, 0, thread_number);
+    for (size_t i=0; i<thread_engines.size(); ++i)
+    {
+        thread_engines[i]->join();
+        delete thread_engines[i];
+    }
+
+    if (context.errcode != 0)
+    {
+        if (NULL == filepath)
+            THROW_SYSCALL_EXCEPTION(NULL, context.errcode, "pread");
+        else
+            THROW_SYSCALL_EXCEPTION(
+                    utils::CStringUtils::format_string("read file://%s failed: %s",
+                            filepath, strerror(context.errcode)),
+                    context.errcode, "pread");
+    }
+
+    utils::CMd5Helper md5;
+    md5.update(reinterpret_cast<const char*>(&context.digests[0]), context.digests.size());
+    *md5_str = md5.to_string();
+    return true;
+}
+
+bool CFileUtils::tree_md5sum(std::string* md5_str, const char* filepath, size_t chunk_size, int num_threads)
+{
+    const int fd = open(filepath, O_RDONLY);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(
+                utils::CStringUtils::format_string("open file://%s failed: %s",
+                        filepath, strerror(errno)),
+                errno, "open");
+
+    sys::CloseHelper<int> ch(fd);
+    return tree_md5sum(md5_str, fd, chunk_size, num_threads, filepath);
+}
+
 bool CFileUtils::md5sum(std::string* md5_str, const char* filepath)
 {
     const int fd = open(filepath, O_RDONLY);
@@ -85,14 +200,160 @@ bool CFileUtils::md5sum(std::string* md5_str, const char* filepath)
     }
 }
 
-bool CFileUtils::compare(int fdA, int fdB)
+// 大块的读写缓冲区，按页对齐，以便也可用于O_DIRECT打开的文件
+#define COPY_BUFFER_SIZE (1024*1024)
+#define COPY_RANGE_MAX (1024*1024*1024)
+
+class CAlignedBuffer
+{
+public:
+    CAlignedBuffer(size_t size)
+        : _buffer(NULL)
+    {
+        void* buffer = NULL;
+        int errcode = posix_memalign(&buffer, 4096, size);
+        if (errcode != 0)
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "posix_memalign");
+        _buffer = static_cast<char*>(buffer);
+    }
+
+    ~CAlignedBuffer()
+    {
+        free(_buffer);
+    }
+
+    char* get() const { return _buffer; }
+
+private:
+    char* _buffer;
+};
+
+// 并行处理文件中各块的上下文，各线程依次取下一块处理，任一块出错或已得到结果时停止
+struct ChunkContext
+{
+    int fdA;                // 比较时为两个文件，复制时为源和目的
+    int fdB;
+    off_t file_size;
+    size_t chunk_size;
+    size_t chunk_number;
+    atomic_t next_chunk;
+    volatile int errcode;
+    volatile bool stopped;
+    const char* syscall_name; // 出错的系统调用
+    // 出错返回errno，需要停止（如比较时发现不同）时设置stopped
+    int (*handle)(ChunkContext* context, off_t offset, size_t size, char* buffer, size_t buffer_size);
+};
+
+static void chunk_worker(ChunkContext* context)
+{
+    CAlignedBuffer buffer(2*COPY_BUFFER_SIZE);
+
+    while ((0 == context->errcode) && !context->stopped)
+    {
+        const size_t chunk = static_cast<size_t>(atomic_inc_return(&context->next_chunk) - 1);
+        if (chunk >= context->chunk_number)
+            break;
+
+        const off_t offset = static_cast<off_t>(chunk * context->chunk_size);
+        const size_t size = std::min(context->chunk_size, static_cast<size_t>(context->file_size - offset));
+        const int errcode = (*context->handle)(context, offset, size, buffer.get(), COPY_BUFFER_SIZE);
+        if (errcode != 0)
+            context->errcode = errcode;
+    }
+}
+
+static void run_chunks(ChunkContext* context, int num_threads)
+{
+    context->chunk_size = std::max<size_t>(context->chunk_size, COPY_BUFFER_SIZE);
+    context->chunk_number = (context->file_size + context->chunk_size - 1) / context->chunk_size;
+    atomic_set(&context->next_chunk, 0);
+    context->errcode = 0;
+    context->stopped = false;
+
+    const size_t thread_number = std::max<size_t>(1, std::min<size_t>(num_threads, context->chunk_number));
+    std::vector<CThreadEngine*> thread_engines(thread_number-1);
+    for (size_t i=1; i<thread_number; ++i)
+        thread_engines[i-1] = new CThreadEngine(bind(&chunk_worker, context));
+    chunk_worker(context);
+    for (size_t i=0; i<thread_engines.size(); ++i)
+    {
+        thread_engines[i]->join();
+        delete thread_engines[i];
+    }
+
+    if (context->errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, context->errcode, context->syscall_name);
+}
+
+// 读满size字节，出错返回errno，文件被截断返回EIO
+static int full_pread(int fd, char* buffer, size_t size, off_t offset)
+{
+    while (size > 0)
+    {
+        const ssize_t n = pread(fd, buffer, size, offset);
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            return errno;
+        }
+        if (0 == n)
+            return EIO;
+
+        buffer += n;
+        offset += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+static int compare_chunk(ChunkContext* context, off_t offset, size_t size, char* buffer, size_t buffer_size)
+{
+    (void)posix_fadvise(context->fdA, offset, size, POSIX_FADV_WILLNEED);
+    (void)posix_fadvise(context->fdB, offset, size, POSIX_FADV_WILLNEED);
+
+    // buffer为两倍buffer_size，前一半放A，后一半放B
+    while ((size > 0) && !context->stopped)
+    {
+        const size_t n = std::min(size, buffer_size);
+        int errcode = full_pread(context->fdA, buffer, n, offset);
+        if (0 == errcode)
+            errcode = full_pread(context->fdB, buffer+buffer_size, n, offset);
+        if (errcode != 0)
+            return errcode;
+
+        if (memcmp(buffer, buffer+buffer_size, n) != 0)
+        {
+            context->stopped = true;
+            break;
+        }
+        offset += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+bool CFileUtils::compare(int fdA, int fdB, int num_threads)
 {
     try
     {
-        std::string fileA_md5, fileB_md5;
-        const bool r1 = md5sum(&fileA_md5, fdA);
-        const bool r2 = md5sum(&fileB_md5, fdB);
-        return (!r1 && !r2) || (fileA_md5==fileB_md5);
+        const off_t file_size = get_file_size(fdA);
+        if (get_file_size(fdB) != file_size)
+            return false;
+        if (0 == file_size)
+            return true;
+
+        ChunkContext context;
+        context.fdA = fdA;
+        context.fdB = fdB;
+        context.file_size = file_size;
+        context.chunk_size = 64*1024*1024;
+        context.syscall_name = "pread";
+        context.handle = compare_chunk;
+        run_chunks(&context, num_threads);
+        return !context.stopped;
     }
     catch (CSyscallException& ex)
     {
@@ -102,21 +363,33 @@ bool CFileUtils::compare(int fdA, int fdB)
     }
 }
 
-bool CFileUtils::compare(const char* fileA, const char* fileB)
+bool CFileUtils::compare(const char* fileA, const char* fileB, int num_threads)
 {
-    try
+    const int fdA = open(fileA, O_RDONLY);
+    if (-1 == fdA)
     {
-        std::string fileA_md5, fileB_md5;
-        const bool r1 = md5sum(&fileA_md5, fileA);
-        const bool r2 = md5sum(&fileB_md5, fileB);
-        return (!r1 && !r2) || (fileA_md5==fileB_md5);
+        if (ENOENT == errno)
+            return false;
+        THROW_SYSCALL_EXCEPTION(
+                utils::CStringUtils::format_string("open file://%s failed: %s",
+                        fileA, strerror(errno)),
+                errno, "open");
     }
-    catch (CSyscallException& ex)
+
+    sys::CloseHelper<int> chA(fdA);
+    const int fdB = open(fileB, O_RDONLY);
+    if (-1 == fdB)
     {
-        if (ENOENT == ex.errcode())
+        if (ENOENT == errno)
             return false;
-        throw;
+        THROW_SYSCALL_EXCEPTION(
+                utils::CStringUtils::format_string("open file://%s failed: %s",
+                        fileB, strerror(errno)),
+                errno, "open");
     }
+
+    sys::CloseHelper<int> chB(fdB);
+    return compare(fdA, fdB, num_threads);
 }
 
 bool CFileUtils::exists(const char* filepath)
@@ -136,30 +409,99 @@ bool CFileUtils::exists(const char* filepath)
     }
 }
 
+// 不支持的文件或文件系统，应换一种方式复制
+static bool is_unsupported(int errcode)
+{
+    return (ENOSYS == errcode) || (EXDEV == errcode) || (EINVAL == errcode)
+        || (EOPNOTSUPP == errcode) || (ENOTTY == errcode) || (EBADF == errcode);
+}
+
+// 写满size字节
+static void full_write(int fd, const char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t n = write(fd, buffer, size);
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
+        }
+
+        buffer += n;
+        size -= n;
+    }
+}
+
+// 两个文件都在开头且目的文件为空时，以FICLONE让两个文件共享数据块
+static bool clone_file(int src_fd, int dst_fd, size_t* file_size)
+{
+    struct stat src_st, dst_st;
+    if ((-1 == fstat(src_fd, &src_st)) || (-1 == fstat(dst_fd, &dst_st))
+     || !S_ISREG(src_st.st_mode) || !S_ISREG(dst_st.st_mode) || (dst_st.st_size != 0)
+     || (lseek(src_fd, 0, SEEK_CUR) != 0) || (lseek(dst_fd, 0, SEEK_CUR) != 0))
+        return false;
+    if (-1 == ioctl(dst_fd, FICLONE, src_fd))
+        return false;
+
+    *file_size = static_cast<size_t>(src_st.st_size);
+    (void)lseek(src_fd, src_st.st_size, SEEK_SET);
+    (void)lseek(dst_fd, src_st.st_size, SEEK_SET);
+    return true;
+}
+
 size_t CFileUtils::file_copy(int src_fd, int dst_fd)
 {
-    char buf[IO_BUFFER_MAX];
     size_t file_size = 0;
+    if (clone_file(src_fd, dst_fd, &file_size))
+        return file_size;
 
+    // 偏移为NULL时使用并更新文件的当前偏移，所以中途退回其它方式时可以接着复制
     for (;;)
-    {    
-        ssize_t ret = read(src_fd, buf, sizeof(buf)-1);
-        if (ret > 0)
-        {      
-            for (;;)
-            {            
-                if (write(dst_fd, buf, ret) != ret)
-                {
-                    if (EINTR == errno) continue;
-                    THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
-                }
-
-                break;
-            }
+    {
+        const ssize_t n = copy_file_range(src_fd, NULL, dst_fd, NULL, COPY_RANGE_MAX, 0);
+        if (n > 0)
+        {
+            file_size += static_cast<size_t>(n);
+            continue;
+        }
+        if (0 == n)
+            return file_size;
+        if (EINTR == errno)
+            continue;
+        if (is_unsupported(errno))
+            break;
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "copy_file_range");
+    }
+    for (;;)
+    {
+        const ssize_t n = sendfile(dst_fd, src_fd, NULL, COPY_RANGE_MAX);
+        if (n > 0)
+        {
+            file_size += static_cast<size_t>(n);
+            continue;
+        }
+        if (0 == n)
+            return file_size;
+        if (EINTR == errno)
+            continue;
+        if (is_unsupported(errno))
+            break;
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "sendfile");
+    }
 
-            file_size += (size_t)ret;
+    CAlignedBuffer buffer(COPY_BUFFER_SIZE);
+    (void)posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    for (;;)
+    {
+        const ssize_t n = read(src_fd, buffer.get(), COPY_BUFFER_SIZE);
+        if (n > 0)
+        {
+            full_write(dst_fd, buffer.get(), static_cast<size_t>(n));
+            file_size += static_cast<size_t>(n);
         }
-        else if (0 == ret)
+        else if (0 == n)
         {
             break;
         }
@@ -173,20 +515,19 @@ size_t CFileUtils::file_copy(int src_fd, int dst_fd)
     return file_size;
 }
 
-size_t CFileUtils::file_copy(int src_fd, const char* dst_filename)
-{    
-    int dst_fd = open(dst_filename, O_WRONLY|O_CREAT|O_EXCL);
-    if (-1 == src_fd)
+// 创建目的文件，权限模式同源文件
+static int create_dst_file(int src_fd, const char* dst_filename)
+{
+    int dst_fd = open(dst_filename, O_WRONLY|O_CREAT|O_EXCL, CFileUtils::get_file_mode(src_fd) & 07777);
+    if (-1 == dst_fd)
         THROW_SYSCALL_EXCEPTION(
                 utils::CStringUtils::format_string("open file://%s failed: %s",
                         dst_filename, strerror(errno)),
                 errno, "open");
-
-    sys::CloseHelper<int> ch(dst_fd);
-    return file_copy(src_fd, dst_fd);
+    return dst_fd;
 }
 
-size_t CFileUtils::file_copy(const char* src_filename, int dst_fd)
+static int open_src_file(const char* src_filename)
 {
     int src_fd = open(src_filename, O_RDONLY);
     if (-1 == src_fd)
@@ -194,30 +535,146 @@ size_t CFileUtils::file_copy(const char* src_filename, int dst_fd)
                 utils::CStringUtils::format_string("open file://%s failed: %s",
                         src_filename, strerror(errno)),
                 errno, "open");
+    return src_fd;
+}
+
+size_t CFileUtils::file_copy(int src_fd, const char* dst_filename)
+{
+    int dst_fd = create_dst_file(src_fd, dst_filename);
+    sys::CloseHelper<int> ch(dst_fd);
+    return file_copy(src_fd, dst_fd);
+}
 
+size_t CFileUtils::file_copy(const char* src_filename, int dst_fd)
+{
+    int src_fd = open_src_file(src_filename);
     sys::CloseHelper<int> ch(src_fd);
     return file_copy(src_fd, dst_fd);
 }
 
 size_t CFileUtils::file_copy(const char* src_filename, const char* dst_filename)
-{ 
-    int src_fd = open(src_filename, O_RDONLY);
-    if (-1 == src_fd)
-        THROW_SYSCALL_EXCEPTION(
-                utils::CStringUtils::format_string("open file://%s failed: %s",
-                        src_filename, strerror(errno)),
-                errno, "open");
+{
+    int src_fd = open_src_file(src_filename);
+    sys::CloseHelper<int> src_ch(src_fd);
+    int dst_fd = create_dst_file(src_fd, dst_filename);
+    sys::CloseHelper<int> dst_ch(dst_fd);
+    return file_copy(src_fd, dst_fd);
+}
 
+// 以显式的偏移复制，不改变文件的当前偏移，可多个线程同时复制不同的块
+static int copy_chunk(ChunkContext* context, off_t offset, size_t size, char* buffer, size_t buffer_size)
+{
+    loff_t src_offset = offset;
+    loff_t dst_offset = offset;
+    while (size > 0)
+    {
+        const ssize_t n = copy_file_range(context->fdA, &src_offset, context->fdB, &dst_offset, size, 0);
+        if (n > 0)
+        {
+            size -= static_cast<size_t>(n);
+            continue;
+        }
+        if (0 == n)
+            return EIO;
+        if (EINTR == errno)
+            continue;
+        if (is_unsupported(errno))
+            break;
+        return errno;
+    }
+
+    (void)posix_fadvise(context->fdA, src_offset, size, POSIX_FADV_SEQUENTIAL);
+    while (size > 0)
+    {
+        const size_t n = std::min(size, buffer_size);
+        int errcode = full_pread(context->fdA, buffer, n, src_offset);
+        if (errcode != 0)
+            return errcode;
+
+        for (size_t written=0; written<n;)
+        {
+            const ssize_t m = pwrite(context->fdB, buffer+written, n-written, dst_offset+written);
+            if (-1 == m)
+            {
+                if (EINTR == errno)
+                    continue;
+                return errno;
+            }
+            written += static_cast<size_t>(m);
+        }
+
+        src_offset += n;
+        dst_offset += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+size_t CFileUtils::parallel_file_copy(const char* src_filename, const char* dst_filename, size_t chunk_size, int num_threads)
+{
+    int src_fd = open_src_file(src_filename);
     sys::CloseHelper<int> src_ch(src_fd);
-    int dst_fd = open(dst_filename, O_WRONLY|O_CREAT|O_EXCL);
-    if (-1 == dst_fd)
-        THROW_SYSCALL_EXCEPTION(
-                utils::CStringUtils::format_string("open file://%s failed: %s",
-                        dst_filename, strerror(errno)),
-                errno, "open");
+    int dst_fd = create_dst_file(src_fd, dst_filename);
+    sys::CloseHelper<int> dst_ch(dst_fd);
+
+    size_t file_size = 0;
+    if (clone_file(src_fd, dst_fd, &file_size))
+        return file_size;
+
+    // 先设好目的文件的大小，各块再写到各自的位置
+    ChunkContext context;
+    context.fdA = src_fd;
+    context.fdB = dst_fd;
+    context.file_size = get_file_size(src_fd);
+    context.chunk_size = chunk_size;
+    context.syscall_name = "copy_file_range";
+    context.handle = copy_chunk;
+    if (-1 == ftruncate(dst_fd, context.file_size))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "ftruncate");
+
+    run_chunks(&context, num_threads);
+    return static_cast<size_t>(context.file_size);
+}
+
+size_t CFileUtils::file_copy_md5sum(int src_fd, int dst_fd, std::string* md5_str)
+{
+    CAlignedBuffer buffer(COPY_BUFFER_SIZE);
+    utils::CMd5Helper md5;
+    size_t file_size = 0;
 
+    (void)posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    for (;;)
+    {
+        const ssize_t n = read(src_fd, buffer.get(), COPY_BUFFER_SIZE);
+        if (n > 0)
+        {
+            md5.update(buffer.get(), n);
+            full_write(dst_fd, buffer.get(), static_cast<size_t>(n));
+            file_size += static_cast<size_t>(n);
+        }
+        else if (0 == n)
+        {
+            break;
+        }
+        else
+        {
+            if (EINTR == errno) continue;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
+        }
+    }
+
+    *md5_str = md5.to_string();
+    return file_size;
+}
+
+size_t CFileUtils::file_copy_md5sum(const char* src_filename, const char* dst_filename, std::string* md5_str)
+{
+    int src_fd = open_src_file(src_filename);
+    sys::CloseHelper<int> src_ch(src_fd);
+    int dst_fd = create_dst_file(src_fd, dst_filename);
     sys::CloseHelper<int> dst_ch(dst_fd);
-    return file_copy(src_fd, dst_fd);
+    return file_copy_md5sum(src_fd, dst_fd, md5_str);
 }
 
 off_t CFileUtils::get_file_size(int fd)
@@ -245,44 +702,45 @@ off_t CFileUtils::get_file_size(const char* filepath)
     return get_file_size(fd);
 }
 
-uint32_t CFileUtils::crc32_file(int fd)
+// 以大块顺序读取整个文件，一次读一页时系统调用次数太多
+static uint32_t checksum_file(int fd, utils::CCrc32::polynomial_t polynomial)
 {
-    uint32_t crc = 0;
-    int page_size = sys::CUtils::get_page_size();
-    char* buffer = new char[page_size];
+    static const size_t buffer_size = 1024*1024;
+    char* buffer = new char[buffer_size];
     utils::DeleteHelper<char> dh(buffer, true);
+    utils::CCrc32 crc32(polynomial);
 
     if (-1 == lseek(fd, 0, SEEK_SET))
     {
         THROW_SYSCALL_EXCEPTION(NULL, errno, "lseek");
     }
+
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
     for (;;)
     {
-        int retval = read(fd, buffer, page_size);
+        ssize_t retval = read(fd, buffer, buffer_size);
         if (0 == retval)
         {
             break;
         }
         if (-1 == retval)
         {
+            if (EINTR == errno)
+                continue;
             THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
         }
 
-        crc = crc32(crc, (unsigned char*)buffer, retval);
-        if (retval < page_size)
-        {
-            break;
-        }
+        crc32.update(buffer, static_cast<size_t>(retval));
     }
     if (-1 == lseek(fd, 0, SEEK_SET))
     {
         THROW_SYSCALL_EXCEPTION(NULL, errno, "lseek");
     }
-    
-    return crc;
+
+    return crc32.get_value();
 }
 
-uint32_t CFileUtils::crc32_file(const char* filepath)
+static int open_for_checksum(const char* filepath)
 {
     int fd = open(filepath, O_RDONLY);
     if (-1 == fd)
@@ -290,11 +748,33 @@ uint32_t CFileUtils::crc32_file(const char* filepath)
                 utils::CStringUtils::format_string("open file://%s failed: %s",
                         filepath, strerror(errno)),
                 errno, "open");
+    return fd;
+}
 
+uint32_t CFileUtils::crc32_file(int fd)
+{
+    return checksum_file(fd, utils::CCrc32::poly_ieee);
+}
+
+uint32_t CFileUtils::crc32_file(const char* filepath)
+{
+    int fd = open_for_checksum(filepath);
     sys::CloseHelper<int> ch(fd);
     return crc32_file(fd);
 }
 
+uint32_t CFileUtils::crc32c_file(int fd)
+{
+    return checksum_file(fd, utils::CCrc32::poly_castagnoli);
+}
+
+uint32_t CFileUtils::crc32c_file(const char* filepath)
+{
+    int fd = open_for_checksum(filepath);
+    sys::CloseHelper<int> ch(fd);
+    return crc32c_file(fd);
+}
+
 uint32_t CFileUtils::get_file_mode(int fd)
 {
     struct stat st;
@@ -0,0 +1,442 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/flight_recorder.h"
+#include "sys/clock.h"
+#include "sys/close_helper.h"
+#include "sys/datetime_utils.h"
+#include "sys/syscall_exception.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+SYS_NAMESPACE_BEGIN
+
+// 转储文件的格式，均为本机字节序：
+// 文件头，之后为name_number个命名（FlightNameHeader和名字），再之后为ring_number个线程（FlightRingHeader和capacity个事件）
+#define FLIGHT_MAGIC "MOOONFR\1"
+enum { FLIGHT_VERSION = 1 };
+
+struct FlightFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t pid;
+    int32_t signo;
+    uint64_t monotonic_ns;
+    uint64_t realtime_ns;
+    uint32_t name_number;
+    uint32_t ring_number;
+};
+
+struct FlightNameHeader
+{
+    uint16_t event_id;
+    uint16_t name_length;
+};
+
+struct FlightRingHeader
+{
+    uint32_t thread_id;
+    uint32_t capacity;
+    uint64_t head;
+    char thread_name[16];
+};
+
+// 每个线程的环形缓冲区，以无锁的单链表串起来，只增不删，
+// 这样信号处理函数中不加锁也可以安全地遍历
+struct FlightRing
+{
+    FlightRingHeader header; // header.head为已写入的事件总数，只由所属线程写
+    FlightRing* next;
+    int in_use;              // 线程退出后为0，可被新线程重用
+    flight_event_t events[1];
+};
+
+bool CFlightRecorder::_enabled = false;
+static uint32_t sg_flight_capacity = 1024;
+static FlightRing* sg_flight_rings = NULL;
+static const char* sg_flight_event_names[FLIGHT_EVENT_ID_MAX];
+static char sg_flight_crash_filename[PATH_MAX];
+static int sg_flight_dumping = 0;
+static __thread FlightRing* sg_flight_ring = NULL;
+static pthread_key_t sg_flight_key;
+static pthread_once_t sg_flight_once = PTHREAD_ONCE_INIT;
+
+// 线程退出时交还缓冲区，其中的事件保留到被重用为止
+static void release_flight_ring(void* ring)
+{
+    __atomic_store_n(&static_cast<FlightRing*>(ring)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void create_flight_key()
+{
+    (void)pthread_key_create(&sg_flight_key, release_flight_ring);
+}
+
+static FlightRing* acquire_flight_ring(uint32_t capacity)
+{
+    for (FlightRing* ring=__atomic_load_n(&sg_flight_rings, __ATOMIC_ACQUIRE); ring!=NULL; ring=ring->next)
+    {
+        int expected = 0;
+        if ((ring->header.capacity == capacity)
+         && __atomic_compare_exchange_n(&ring->in_use, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            // 先使所有槽无效，再清零总数，转储看到的要么是旧线程的，要么是空的
+            for (uint32_t i=0; i<capacity; ++i)
+                __atomic_store_n(&ring->events[i].sequence, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&ring->header.head, 0, __ATOMIC_RELEASE);
+            return ring;
+        }
+    }
+
+    FlightRing* ring = static_cast<FlightRing*>(calloc(1, sizeof(FlightRing) + sizeof(flight_event_t) * (capacity - 1)));
+    if (NULL == ring)
+        return NULL;
+    ring->header.capacity = capacity;
+    ring->in_use = 1;
+    ring->next = __atomic_load_n(&sg_flight_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&sg_flight_rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return ring;
+}
+
+static FlightRing* get_flight_ring()
+{
+    if (NULL == sg_flight_ring)
+    {
+        (void)pthread_once(&sg_flight_once, create_flight_key);
+        FlightRing* ring = acquire_flight_ring(__atomic_load_n(&sg_flight_capacity, __ATOMIC_RELAXED));
+        if (NULL == ring)
+            return NULL;
+
+        ring->header.thread_id = static_cast<uint32_t>(syscall(SYS_gettid));
+        memset(ring->header.thread_name, 0, sizeof(ring->header.thread_name));
+        (void)pthread_getname_np(pthread_self(), ring->header.thread_name, sizeof(ring->header.thread_name));
+        (void)pthread_setspecific(sg_flight_key, ring);
+        sg_flight_ring = ring;
+    }
+
+    return sg_flight_ring;
+}
+
+void CFlightRecorder::enable(bool enabled, uint32_t events_per_thread)
+{
+    uint32_t capacity = 2;
+    while ((capacity < events_per_thread) && (capacity < 0x80000000U))
+        capacity <<= 1;
+
+    __atomic_store_n(&sg_flight_capacity, capacity, __ATOMIC_RELAXED);
+    __atomic_store_n(&_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+// 先将序号置0再写内容，最后写入序号，转储时序号与位置对不上的槽被丢弃
+void CFlightRecorder::record(uint16_t event_id, const void* payload, uint16_t payload_size)
+{
+    FlightRing* ring = get_flight_ring();
+    if (NULL == ring)
+        return;
+
+    const uint64_t head = ring->header.head;
+    flight_event_t& event = ring->events[head & (ring->header.capacity - 1)];
+    __atomic_store_n(&event.sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    event.timestamp_ns = CClock::get_nanoseconds();
+    event.event_id = event_id;
+    event.payload_size = (payload_size > FLIGHT_PAYLOAD_MAX)? FLIGHT_PAYLOAD_MAX: payload_size;
+    if (event.payload_size > 0)
+        memcpy(event.payload, payload, event.payload_size);
+
+    __atomic_store_n(&event.sequence, static_cast<uint32_t>(head + 1), __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->header.head, head + 1, __ATOMIC_RELEASE);
+}
+
+void CFlightRecorder::record(uint16_t event_id, uint64_t value1, uint64_t value2)
+{
+    uint64_t values[2] = { value1, value2 };
+    record(event_id, values, sizeof(values));
+}
+
+void CFlightRecorder::name_event(uint16_t event_id, const char* name)
+{
+    if (event_id < FLIGHT_EVENT_ID_MAX)
+        __atomic_store_n(&sg_flight_event_names[event_id], name, __ATOMIC_RELEASE);
+}
+
+void CFlightRecorder::clear()
+{
+    for (FlightRing* ring=__atomic_load_n(&sg_flight_rings, __ATOMIC_ACQUIRE); ring!=NULL; ring=ring->next)
+    {
+        for (uint32_t i=0; i<ring->header.capacity; ++i)
+            ring->events[i].sequence = 0;
+        __atomic_store_n(&ring->header.head, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        const ssize_t bytes = write(fd, p, size);
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            return false;
+        }
+
+        p += bytes;
+        size -= static_cast<size_t>(bytes);
+    }
+    return true;
+}
+
+bool CFlightRecorder::dump(int fd, int signo)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+
+    FlightFileHeader file_header;
+    memset(&file_header, 0, sizeof(file_header));
+    memcpy(file_header.magic, FLIGHT_MAGIC, sizeof(file_header.magic));
+    file_header.version = FLIGHT_VERSION;
+    file_header.event_size = sizeof(flight_event_t);
+    file_header.pid = static_cast<uint32_t>(getpid());
+    file_header.signo = signo;
+    file_header.monotonic_ns = CClock::get_nanoseconds();
+    file_header.realtime_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+    // 转储期间新加入的线程不计入，只转储计数时已有的
+    FlightRing* rings = __atomic_load_n(&sg_flight_rings, __ATOMIC_ACQUIRE);
+    for (int i=0; i<FLIGHT_EVENT_ID_MAX; ++i)
+        if (__atomic_load_n(&sg_flight_event_names[i], __ATOMIC_ACQUIRE) != NULL)
+            ++file_header.name_number;
+    for (FlightRing* ring=rings; ring!=NULL; ring=ring->next)
+        ++file_header.ring_number;
+    if (!write_all(fd, &file_header, sizeof(file_header)))
+        return false;
+
+    uint32_t name_number = 0;
+    for (int i=0; (i<FLIGHT_EVENT_ID_MAX) && (name_number<file_header.name_number); ++i)
+    {
+        const char* name = __atomic_load_n(&sg_flight_event_names[i], __ATOMIC_ACQUIRE);
+        if (NULL == name)
+            continue;
+
+        FlightNameHeader name_header;
+        const size_t name_length = strlen(name);
+        name_header.event_id = static_cast<uint16_t>(i);
+        name_header.name_length = static_cast<uint16_t>((name_length > 0xFFFF)? 0xFFFF: name_length);
+        if (!write_all(fd, &name_header, sizeof(name_header)) || !write_all(fd, name, name_header.name_length))
+            return false;
+        ++name_number;
+    }
+    for (; name_number<file_header.name_number; ++name_number)
+    {
+        // 计数之后才命名的被跳过，此处补一个空名字，保持个数一致
+        FlightNameHeader name_header = { 0, 0 };
+        if (!write_all(fd, &name_header, sizeof(name_header)))
+            return false;
+    }
+
+    for (FlightRing* ring=rings; ring!=NULL; ring=ring->next)
+    {
+        FlightRingHeader ring_header = ring->header;
+        ring_header.head = __atomic_load_n(&ring->header.head, __ATOMIC_ACQUIRE);
+        if (!write_all(fd, &ring_header, sizeof(ring_header))
+         || !write_all(fd, ring->events, sizeof(flight_event_t) * ring_header.capacity))
+            return false;
+    }
+    return true;
+}
+
+void CFlightRecorder::dump(const std::string& filename)
+{
+    const int fd = open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(filename, errno, "open");
+
+    sys::CloseHelper<int> close_helper(fd);
+    if (!dump(fd, 0))
+        THROW_SYSCALL_EXCEPTION(filename, errno, "write");
+}
+
+void CFlightRecorder::set_crash_filename(const std::string& filename)
+{
+    const size_t size = std::min(filename.size(), sizeof(sg_flight_crash_filename) - 1);
+    memcpy(sg_flight_crash_filename, filename.data(), size);
+    sg_flight_crash_filename[size] = '\0';
+}
+
+void CFlightRecorder::dump_on_signal(int signo)
+{
+    // 多个线程同时崩溃时只转储一次
+    if (('\0' == sg_flight_crash_filename[0]) || (__atomic_exchange_n(&sg_flight_dumping, 1, __ATOMIC_ACQ_REL) != 0))
+        return;
+
+    const int errcode = errno;
+    const int fd = open(sg_flight_crash_filename, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, FILE_DEFAULT_PERM);
+    if (fd != -1)
+    {
+        (void)dump(fd, signo);
+        (void)close(fd);
+    }
+    __atomic_store_n(&sg_flight_dumping, 0, __ATOMIC_RELEASE);
+    errno = errcode;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CFlightReader::CFlightReader()
+    : _pid(0), _signo(0), _monotonic_ns(0), _realtime_ns(0)
+{
+}
+
+// 从data的offset处取size字节，不够时抛出异常
+static const char* take(const std::string& data, size_t* offset, size_t size)
+{
+    if (data.size() - *offset < size)
+        THROW_EXCEPTION("truncated flight recorder file", -1);
+
+    const char* p = data.data() + *offset;
+    *offset += size;
+    return p;
+}
+
+void CFlightReader::open(const std::string& filename)
+{
+    const int fd = ::open(filename.c_str(), O_RDONLY|O_CLOEXEC);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(filename, errno, "open");
+
+    sys::CloseHelper<int> close_helper(fd);
+    std::string data;
+    char buffer[8192];
+    for (;;)
+    {
+        const ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (0 == bytes)
+            break;
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            THROW_SYSCALL_EXCEPTION(filename, errno, "read");
+        }
+        data.append(buffer, static_cast<size_t>(bytes));
+    }
+
+    size_t offset = 0;
+    FlightFileHeader file_header;
+    memcpy(&file_header, take(data, &offset, sizeof(file_header)), sizeof(file_header));
+    if ((memcmp(file_header.magic, FLIGHT_MAGIC, sizeof(file_header.magic)) != 0)
+     || (file_header.version != FLIGHT_VERSION) || (file_header.event_size != sizeof(flight_event_t)))
+        THROW_EXCEPTION("not a flight recorder file", -1);
+
+    _pid = file_header.pid;
+    _signo = file_header.signo;
+    _monotonic_ns = file_header.monotonic_ns;
+    _realtime_ns = file_header.realtime_ns;
+    _event_names.clear();
+    _threads.clear();
+
+    for (uint32_t i=0; i<file_header.name_number; ++i)
+    {
+        FlightNameHeader name_header;
+        memcpy(&name_header, take(data, &offset, sizeof(name_header)), sizeof(name_header));
+        const char* name = take(data, &offset, name_header.name_length);
+        if (name_header.name_length > 0)
+        {
+            if (name_header.event_id >= _event_names.size())
+                _event_names.resize(name_header.event_id + 1);
+            _event_names[name_header.event_id].assign(name, name_header.name_length);
+        }
+    }
+
+    for (uint32_t i=0; i<file_header.ring_number; ++i)
+    {
+        FlightRingHeader ring_header;
+        memcpy(&ring_header, take(data, &offset, sizeof(ring_header)), sizeof(ring_header));
+        if ((ring_header.capacity < 2) || ((ring_header.capacity & (ring_header.capacity - 1)) != 0))
+            THROW_EXCEPTION("invalid capacity in flight recorder file", -1);
+        const char* events = take(data, &offset, sizeof(flight_event_t) * static_cast<size_t>(ring_header.capacity));
+
+        // 只取序号和位置相符的，转储时正在写或已被覆盖的被丢弃
+        flight_thread_t thread;
+        thread.thread_id = ring_header.thread_id;
+        thread.thread_name.assign(ring_header.thread_name, strnlen(ring_header.thread_name, sizeof(ring_header.thread_name)));
+        thread.event_number = ring_header.head;
+        const uint64_t begin = (ring_header.head > ring_header.capacity)? ring_header.head - ring_header.capacity: 0;
+        for (uint64_t index=begin; index<ring_header.head; ++index)
+        {
+            flight_event_t event;
+            memcpy(&event, events + sizeof(flight_event_t) * (index & (ring_header.capacity - 1)), sizeof(event));
+            if ((event.sequence == static_cast<uint32_t>(index + 1)) && (event.payload_size <= FLIGHT_PAYLOAD_MAX))
+                thread.events.push_back(event);
+        }
+        _threads.push_back(thread);
+    }
+}
+
+std::string CFlightReader::get_datetime(uint64_t timestamp_ns) const
+{
+    // 以转储时的单调时钟和系统时间的对应关系换算
+    const uint64_t realtime_ns = _realtime_ns - (_monotonic_ns - timestamp_ns);
+    const time_t seconds = static_cast<time_t>(realtime_ns / 1000000000);
+    return CDatetimeUtils::to_datetime(seconds) + utils::CStringUtils::format_string(".%09u", static_cast<unsigned int>(realtime_ns % 1000000000));
+}
+
+std::string CFlightReader::get_event_name(uint16_t event_id) const
+{
+    if ((event_id < _event_names.size()) && !_event_names[event_id].empty())
+        return _event_names[event_id];
+    return utils::CStringUtils::format_string("event#%u", static_cast<unsigned int>(event_id));
+}
+
+std::string CFlightReader::format_payload(const flight_event_t& event)
+{
+    if (sizeof(uint64_t) * 2 == event.payload_size)
+    {
+        uint64_t values[2];
+        memcpy(values, event.payload, sizeof(values));
+        return utils::CStringUtils::format_string("%" PRIu64",%" PRIu64, values[0], values[1]);
+    }
+
+    bool printable = true;
+    for (uint16_t i=0; printable && (i<event.payload_size); ++i)
+        printable = (event.payload[i] >= 0x20) && (event.payload[i] < 0x7f);
+    if (printable)
+        return std::string(event.payload, event.payload_size);
+
+    std::string hex;
+    for (uint16_t i=0; i<event.payload_size; ++i)
+        hex += utils::CStringUtils::format_string("%02x", static_cast<unsigned char>(event.payload[i]));
+    return hex;
+}
+
+SYS_NAMESPACE_END
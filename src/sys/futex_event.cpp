@@ -0,0 +1,146 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/futex_event.h"
+#include "sys/clock.h"
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+//////////////////////////////////////////////////////////////////////////
+// CFutexEvent
+
+CFutexEvent::CFutexEvent()
+    :_epoch(0)
+    ,_waiter_number(0)
+{
+}
+
+void CFutexEvent::wake_n(uint32_t n)
+{
+    // 先改序号再检查等待者，和prepare_wait中先登记再读序号配对：
+    // 要么这里看到了等待者，要么等待者读到的是新的序号而不会睡眠
+    __atomic_add_fetch(&_epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_waiter_number, __ATOMIC_SEQ_CST) > 0)
+        (void)syscall(SYS_futex, &_epoch, FUTEX_WAKE_PRIVATE, static_cast<int>(std::min<uint32_t>(n, INT_MAX)), NULL, NULL, 0);
+}
+
+// FUTEX_WAIT的超时是相对时长，按CLOCK_MONOTONIC计，被信号打断时按剩余时长重新等待
+bool CFutexEvent::do_wait(uint32_t epoch, int milliseconds)
+{
+    const uint64_t deadline = (milliseconds < 0)? 0: CClock::get_nanoseconds() + static_cast<uint64_t>(milliseconds) * 1000000;
+    bool woken = false;
+
+    for (;;)
+    {
+        if (__atomic_load_n(&_epoch, __ATOMIC_ACQUIRE) != epoch)
+        {
+            woken = true;
+            break;
+        }
+
+        struct timespec timeout;
+        struct timespec* timeout_ptr = NULL;
+        if (deadline != 0)
+        {
+            const uint64_t now = CClock::get_nanoseconds();
+            if (now >= deadline)
+                break;
+
+            timeout.tv_sec = static_cast<time_t>((deadline - now) / 1000000000);
+            timeout.tv_nsec = static_cast<long>((deadline - now) % 1000000000);
+            timeout_ptr = &timeout;
+        }
+
+        if ((-1 == syscall(SYS_futex, &_epoch, FUTEX_WAIT_PRIVATE, epoch, timeout_ptr, NULL, 0)) && (ETIMEDOUT == errno))
+        {
+            woken = (__atomic_load_n(&_epoch, __ATOMIC_ACQUIRE) != epoch);
+            break;
+        }
+    }
+
+    cancel_wait();
+    return woken;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CFutexSemaphore
+
+CFutexSemaphore::CFutexSemaphore(uint32_t value)
+    :_value(value)
+{
+}
+
+void CFutexSemaphore::post(uint32_t value)
+{
+    if (value > 0)
+    {
+        __atomic_add_fetch(&_value, value, __ATOMIC_RELEASE);
+        _event.wake_n(value);
+    }
+}
+
+bool CFutexSemaphore::try_wait()
+{
+    uint32_t value = __atomic_load_n(&_value, __ATOMIC_RELAXED);
+    while (value > 0)
+    {
+        if (__atomic_compare_exchange_n(&_value, &value, value-1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+bool CFutexSemaphore::timed_wait(int milliseconds)
+{
+    const uint64_t deadline = (milliseconds < 0)? 0: CClock::get_nanoseconds() + static_cast<uint64_t>(milliseconds) * 1000000;
+
+    for (;;)
+    {
+        if (try_wait())
+            return true;
+
+        // 登记后再检查一次，post在登记之后发生时序号会变，wait_for立即返回
+        int remaining = -1;
+        const uint32_t epoch = _event.prepare_wait();
+        if (try_wait())
+        {
+            _event.cancel_wait();
+            return true;
+        }
+        if (deadline != 0)
+        {
+            const uint64_t now = CClock::get_nanoseconds();
+            if (now >= deadline)
+            {
+                _event.cancel_wait();
+                return false;
+            }
+            remaining = static_cast<int>((deadline - now + 999999) / 1000000);
+        }
+
+        (void)_event.wait_for(epoch, remaining);
+    }
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,105 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/hedge.h"
+#include <algorithm>
+SYS_NAMESPACE_BEGIN
+
+static CCounter* get_hedge_counter(const std::string& name, const char* suffix)
+{
+    if (name.empty())
+        return NULL;
+    return CMetricsRegistry::get_singleton()->get_counter("hedge." + name + suffix);
+}
+
+CHedgeController::CHedgeController(const CHedgePolicy& policy)
+    : _policy(policy),
+      _delay_milliseconds((policy.delay_milliseconds > 0)? policy.delay_milliseconds: policy.max_delay_milliseconds),
+      _sample_number(0), _budget(static_cast<uint64_t>(policy.budget_burst) * BUDGET_UNIT),
+      _hedge_number(0), _won_number(0), _throttled_number(0),
+      _sent_counter(get_hedge_counter(policy.name, ".sent")),
+      _won_counter(get_hedge_counter(policy.name, ".won")),
+      _throttled_counter(get_hedge_counter(policy.name, ".throttled"))
+{
+}
+
+CHedgeController::~CHedgeController()
+{
+}
+
+uint32_t CHedgeController::on_request()
+{
+    const uint64_t max_budget = static_cast<uint64_t>(_policy.budget_burst) * BUDGET_UNIT;
+    uint64_t budget = __atomic_load_n(&_budget, __ATOMIC_RELAXED);
+    uint64_t new_budget;
+    do
+    {
+        new_budget = std::min(max_budget, budget + _policy.budget_percent);
+    } while ((new_budget != budget)
+          && !__atomic_compare_exchange_n(&_budget, &budget, new_budget, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return get_delay_milliseconds();
+}
+
+bool CHedgeController::try_hedge()
+{
+    uint64_t budget = __atomic_load_n(&_budget, __ATOMIC_RELAXED);
+    do
+    {
+        if (budget < BUDGET_UNIT)
+        {
+            __atomic_add_fetch(&_throttled_number, 1, __ATOMIC_RELAXED);
+            if (_throttled_counter != NULL)
+                _throttled_counter->inc();
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&_budget, &budget, budget - BUDGET_UNIT, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    __atomic_add_fetch(&_hedge_number, 1, __ATOMIC_RELAXED);
+    if (_sent_counter != NULL)
+        _sent_counter->inc();
+    return true;
+}
+
+void CHedgeController::on_complete(uint64_t latency_nanoseconds, bool hedge_won)
+{
+    if (hedge_won)
+    {
+        __atomic_add_fetch(&_won_number, 1, __ATOMIC_RELAXED);
+        if (_won_counter != NULL)
+            _won_counter->inc();
+    }
+    if (_policy.delay_milliseconds > 0)
+        return;
+
+    // 每批样本计算一次百分位，之后清空，使延迟跟随最近的耗时
+    _histogram.record(latency_nanoseconds);
+    if (__atomic_add_fetch(&_sample_number, 1, __ATOMIC_RELAXED) % SAMPLE_NUMBER != 0)
+        return;
+
+    CHistogramSnapshot snapshot;
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        _histogram.get_snapshot(&snapshot, true);
+    }
+    const uint64_t milliseconds = (snapshot.get_percentile(_policy.percentile) + 999999) / 1000000;
+    const uint64_t delay = std::max<uint64_t>(_policy.min_delay_milliseconds, std::min<uint64_t>(_policy.max_delay_milliseconds, milliseconds));
+    __atomic_store_n(&_delay_milliseconds, static_cast<uint32_t>(delay), __ATOMIC_RELAXED);
+}
+
+SYS_NAMESPACE_END
@@ -16,14 +16,220 @@
  *
  * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
  */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include <sys/times.h>
 #include <sys/sysinfo.h>
 #include <sys/resource.h>
 #include "sys/info.h"
+#include "sys/clock.h"
 #include "sys/close_helper.h"
+#include "sys/metrics.h"
 #include "utils/string_utils.h"
 SYS_NAMESPACE_BEGIN
 
+// 以下为解析/proc文件内容的函数，只跳过空格和制表符，不跨行
+static const char* skip_blank(const char* p)
+{
+    while ((' ' == *p) || ('\t' == *p))
+        ++p;
+    return p;
+}
+
+// 解析一个十进制整数，允许负号（按补码存放），失败返回NULL
+static const char* parse_number(const char* p, uint64_t* value)
+{
+    p = skip_blank(p);
+    const bool negative = ('-' == *p);
+    if (negative)
+        ++p;
+    if ((*p < '0') || (*p > '9'))
+        return NULL;
+
+    uint64_t n = 0;
+    do
+    {
+        n = n * 10 + static_cast<uint64_t>(*p - '0');
+        ++p;
+    } while ((*p >= '0') && (*p <= '9'));
+
+    *value = negative? (0 - n): n;
+    return p;
+}
+
+// 依次解析number个整数，失败返回NULL
+static const char* parse_numbers(const char* p, uint64_t* values, int number)
+{
+    for (int i=0; (p != NULL) && (i<number); ++i)
+        p = parse_number(p, &values[i]);
+    return p;
+}
+
+// 得到下一行的开始，没有下一行时返回NULL
+static const char* next_line(const char* p)
+{
+    p = strchr(p, '\n');
+    return ((NULL == p) || ('\0' == p[1]))? NULL: p+1;
+}
+
+// 解析/proc/stat中的CPU行，如：cpu0 user nice system idle iowait irq softirq steal ...，
+// cpu_index为CPU号，总的CPU行为-1
+static bool parse_cpu_line(const char* line, uint64_t values[7], int* cpu_index)
+{
+    if (strncmp(line, "cpu", 3) != 0)
+        return false;
+
+    const char* p = line + 3;
+    if ((*p >= '0') && (*p <= '9'))
+    {
+        uint64_t index;
+        p = parse_number(p, &index);
+        *cpu_index = static_cast<int>(index);
+    }
+    else
+    {
+        *cpu_index = -1;
+    }
+
+    return parse_numbers(p, values, 7) != NULL;
+}
+
+static void to_cpu_info(const uint64_t values[7], CInfo::cpu_info_t* cpu_info)
+{
+    cpu_info->user    = static_cast<uint32_t>(values[0]);
+    cpu_info->nice    = static_cast<uint32_t>(values[1]);
+    cpu_info->system  = static_cast<uint32_t>(values[2]);
+    cpu_info->idle    = static_cast<uint32_t>(values[3]);
+    cpu_info->iowait  = static_cast<uint32_t>(values[4]);
+    cpu_info->irq     = static_cast<uint32_t>(values[5]);
+    cpu_info->softirq = static_cast<uint32_t>(values[6]);
+    cpu_info->total   = values[0] + values[1] + values[2] + values[3] + values[4] + values[5] + values[6];
+}
+
+// 解析/proc/[pid]/stat，进程名在括号中，可能包含空格和括号，所以以最后一个右括号为准
+static bool parse_process_stat(const char* text, CInfo::process_info_t* pi)
+{
+    uint64_t pid;
+    const char* p = parse_number(text, &pid);
+    if (NULL == p) return false;
+    p = skip_blank(p);
+    if (*p != '(') return false;
+
+    const char* right = strrchr(p, ')');
+    if (NULL == right) return false;
+    size_t comm_length = right - (p + 1);
+    if (comm_length >= sizeof(pi->comm))
+        comm_length = sizeof(pi->comm) - 1;
+    memcpy(pi->comm, p+1, comm_length);
+    pi->comm[comm_length] = '\0';
+
+    p = skip_blank(right + 1);
+    if (('\0' == *p) || ('\n' == *p)) return false;
+    pi->state = *p++;
+
+    // 从第4个字段ppid到第39个字段processor，其中第35个字段wchan不保存
+    uint64_t v[36];
+    if (NULL == parse_numbers(p, v, 36)) return false;
+
+    pi->pid         = static_cast<int32_t>(pid);
+    pi->ppid        = static_cast<int32_t>(v[0]);
+    pi->pgrp        = static_cast<int32_t>(v[1]);
+    pi->session     = static_cast<int32_t>(v[2]);
+    pi->tty_nr      = static_cast<int32_t>(v[3]);
+    pi->tpgid       = static_cast<int32_t>(v[4]);
+    pi->flags       = static_cast<uint32_t>(v[5]);
+    pi->minflt      = v[6];
+    pi->cminflt     = v[7];
+    pi->majflt      = v[8];
+    pi->cmajflt     = v[9];
+    pi->utime       = v[10];
+    pi->stime       = v[11];
+    pi->cutime      = static_cast<int64_t>(v[12]);
+    pi->cstime      = static_cast<int64_t>(v[13]);
+    pi->priority    = static_cast<int64_t>(v[14]);
+    pi->nice        = static_cast<int64_t>(v[15]);
+    pi->num_threads = static_cast<int64_t>(v[16]);
+    pi->itrealvalue = static_cast<int64_t>(v[17]);
+    pi->starttime   = static_cast<int64_t>(v[18]);
+    pi->vsize       = v[19];
+    pi->rss         = static_cast<int64_t>(v[20]);
+    pi->rlim        = v[21];
+    pi->startcode   = v[22];
+    pi->endcode     = v[23];
+    pi->startstack  = v[24];
+    pi->kstkesp     = v[25];
+    pi->kstkeip     = v[26];
+    pi->signal      = v[27];
+    pi->blocked     = v[28];
+    pi->sigignore   = v[29];
+    pi->sigcatch    = v[30];
+    pi->nswap       = v[32];
+    pi->cnswap      = v[33];
+    pi->exit_signal = static_cast<int32_t>(v[34]);
+    pi->processor   = static_cast<int32_t>(v[35]);
+    return true;
+}
+
+// 解析/proc/net/dev中的一行，如：  eth0: 1234 56 ...，老的内核网卡名和数字之间没有空格
+static bool parse_net_line(const char* line, CInfo::net_info_t* net_info)
+{
+    const char* p = skip_blank(line);
+    const char* colon = p;
+    while ((*colon != ':') && (*colon != '\n') && (*colon != '\0'))
+        ++colon;
+    if (*colon != ':') return false;
+
+    const size_t name_length = colon - p;
+    if ((0 == name_length) || (name_length >= sizeof(net_info->interface_name))) return false;
+
+    uint64_t v[16];
+    if (NULL == parse_numbers(colon+1, v, 16)) return false;
+
+    memcpy(net_info->interface_name, p, name_length);
+    net_info->interface_name[name_length] = '\0';
+    net_info->receive_bytes        = v[0];
+    net_info->receive_packets      = v[1];
+    net_info->receive_errors       = v[2];
+    net_info->receive_dropped      = v[3];
+    net_info->receive_fifo_errors  = v[4];
+    net_info->receive_frame        = v[5];
+    net_info->receive_compressed   = v[6];
+    net_info->receive_multicast    = v[7];
+    net_info->transmit_bytes       = v[8];
+    net_info->transmit_packets     = v[9];
+    net_info->transmit_errors      = v[10];
+    net_info->transmit_dropped     = v[11];
+    net_info->transmit_fifo_errors = v[12];
+    net_info->transmit_collisions  = v[13];
+    net_info->transmit_carrier     = v[14];
+    net_info->transmit_compressed  = v[15];
+    return true;
+}
+
+// 解析/proc/net/dev，跳过头两行，interface_name不为NULL时只取名字完全相同的网卡
+static void parse_net_dev(const char* text, const char* interface_name, std::vector<CInfo::net_info_t>* net_info_array)
+{
+    const char* line = next_line(text);
+    if (line != NULL)
+        line = next_line(line);
+
+    for (; line!=NULL; line=next_line(line))
+    {
+        CInfo::net_info_t net_info;
+        if (!parse_net_line(line, &net_info))
+            continue;
+        if ((interface_name != NULL) && (strcmp(net_info.interface_name, interface_name) != 0))
+            continue;
+
+        net_info_array->push_back(net_info);
+        if (interface_name != NULL)
+            break;
+    }
+}
+
 CInfo::TSysInfo::TSysInfo()
 {
     uptime_second = 0;
@@ -73,6 +279,7 @@ bool CInfo::get_sys_info(sys_info_t& sys_info)
     return true;
 }
 
+
 // sysconf(_SC_PAGESIZE)
 // sysconf(_SC_PHYS_PAGES);
 // sysconf(_SC_AVPHYS_PAGES);
@@ -81,60 +288,48 @@ bool CInfo::get_sys_info(sys_info_t& sys_info)
 // 可以搜索到关于文件“/proc/meminfo”的结构介绍。
 bool CInfo::get_mem_info(mem_info_t& mem_info)
 {
-    FILE* fp = fopen("/proc/meminfo", "r");
-    if (NULL == fp) return false;
-    sys::CloseHelper<FILE*> ch(fp);
+    CProcFile file;
+    if (!file.open("/proc/meminfo")) return false;
+    const char* text = file.read();
+    if (NULL == text) return false;
 
+    const struct
+    {
+        const char* name;
+        uint32_t* value;
+    } fields[] =
+    {
+        { "MemTotal", &mem_info.mem_total },
+        { "MemFree", &mem_info.mem_free },
+        { "Buffers", &mem_info.buffers },
+        { "Cached", &mem_info.cached },
+        { "SwapCached", &mem_info.swap_cached },
+        { "SwapTotal", &mem_info.swap_total },
+        { "SwapFree", &mem_info.swap_free }
+    };
+    const int member_number = sizeof(fields) / sizeof(fields[0]);
     int i = 0;
-    int value;
-    char name[LINE_MAX];
-    char line[LINE_MAX];
-	int filed_number = 2;
-	int member_number = 7;
 
-    while (fgets(line, sizeof(line)-1, fp))
+    // 每行格式为：MemTotal:       16333852 kB
+    for (const char* line=text; (line!=NULL) && (i<member_number); line=next_line(line))
     {
-        if (sscanf(line, "%s%u", name, &value) != filed_number)
-            continue;
+        const char* colon = strchr(line, ':');
+        if (NULL == colon) break;
 
-        if (0 == strcmp(name, "MemTotal:"))
-        {
-            ++i;
-            mem_info.mem_total = value;
-        }
-        else if (0 == strcmp(name, "MemFree:"))
-        {
-            ++i;
-            mem_info.mem_free = value;
-        }
-        else if (0 == strcmp(name, "Buffers:"))
-        {
-            ++i;
-            mem_info.buffers = value;
-        }
-        else if (0 == strcmp(name, "Cached:"))
+        const size_t name_length = colon - line;
+        for (int j=0; j<member_number; ++j)
         {
-            ++i;
-            mem_info.cached = value;
+            if ((0 == strncmp(line, fields[j].name, name_length)) && ('\0' == fields[j].name[name_length]))
+            {
+                uint64_t value;
+                if (parse_number(colon+1, &value) != NULL)
+                {
+                    *fields[j].value = static_cast<uint32_t>(value);
+                    ++i;
+                }
+                break;
+            }
         }
-        else if (0 == strcmp(name, "SwapCached:"))
-        {
-            ++i;
-            mem_info.swap_cached = value;
-        }
-        else if (0 == strcmp(name, "SwapTotal:"))
-        {
-            ++i;
-            mem_info.swap_total = value;
-        }
-        else if (0 == strcmp(name, "SwapFree:"))
-        {
-            ++i;
-            mem_info.swap_free = value;
-        }
-
-        if (i == member_number)
-            break;
     }
 
     return (i == member_number);
@@ -144,29 +339,19 @@ bool CInfo::get_mem_info(mem_info_t& mem_info)
 // 可以搜索到关于文件“/proc/stat”的结构介绍。
 bool CInfo::get_cpu_info(cpu_info_t& cpu_info)
 {
-    FILE* fp = fopen("/proc/stat", "r");
-    if (NULL == fp) return false;
-    sys::CloseHelper<FILE*> ch(fp);
-
-    char name[LINE_MAX];
-    char line[LINE_MAX];
-    int filed_number = 8;
-
-    while (fgets(line, sizeof(line)-1, fp))
-    {
-        if (sscanf(line, "%s%u%u%u%u%u%u%u", name, &cpu_info.user, &cpu_info.nice, &cpu_info.system, &cpu_info.idle, &cpu_info.iowait, &cpu_info.irq, &cpu_info.softirq) != filed_number)
-            continue;
-        
-        if (0 == strcmp(name, "cpu"))
-        {
-            cpu_info.total = cpu_info.user + cpu_info.nice + cpu_info.system + cpu_info.idle + cpu_info.iowait + cpu_info.irq + cpu_info.softirq;
-            break;
-        }
-
-        name[0] = '\0';        
-    }
+    CProcFile file;
+    if (!file.open("/proc/stat")) return false;
+    const char* text = file.read();
+    if (NULL == text) return false;
+
+    // 总的CPU行总是在第一行
+    uint64_t values[7];
+    int cpu_index;
+    if (!parse_cpu_line(text, values, &cpu_index) || (cpu_index != -1))
+        return false;
 
-    return (name[0] != '\0');
+    to_cpu_info(values, &cpu_info);
+    return true;
 }
 
 // 在Centos Linux上执行：info proc，
@@ -175,24 +360,21 @@ int CInfo::get_cpu_info_array(std::vector<cpu_info_t>& cpu_info_array)
 {
     cpu_info_array.clear();
 
-    FILE* fp = fopen("/proc/stat", "r");
-    if (NULL == fp) return 0;
-    sys::CloseHelper<FILE*> ch(fp);
+    CProcFile file;
+    if (!file.open("/proc/stat")) return 0;
+    const char* text = file.read();
+    if (NULL == text) return 0;
 
-    char name[LINE_MAX];
-    char line[LINE_MAX];
-    int filed_number = 8;
-    
-    while (fgets(line, sizeof(line)-1, fp))
+    // 第一个为总的，之后依次为各CPU
+    for (const char* line=text; line!=NULL; line=next_line(line))
     {
-        cpu_info_t cpu_info;
-        if (sscanf(line, "%s%u%u%u%u%u%u%u", name, &cpu_info.user, &cpu_info.nice, &cpu_info.system, &cpu_info.idle, &cpu_info.iowait, &cpu_info.irq, &cpu_info.softirq) != filed_number)
-            continue;
-
-        if (strncmp(name, "cpu", 3) != 0)
+        uint64_t values[7];
+        int cpu_index;
+        if (!parse_cpu_line(line, values, &cpu_index))
             break;
-        
-        cpu_info.total = cpu_info.user + cpu_info.nice + cpu_info.system + cpu_info.idle + cpu_info.iowait + cpu_info.irq + cpu_info.softirq;
+
+        cpu_info_t cpu_info;
+        to_cpu_info(values, &cpu_info);
         cpu_info_array.push_back(cpu_info);
     }
 
@@ -251,83 +433,23 @@ bool CInfo::get_process_info(process_info_t& process_info, pid_t pid)
     return get_process_info(&process_info, pid);
 }
 
+
 // 在Centos Linux上执行：info proc，
 // 可以搜索到关于文件“/proc/[pid]/stat”的结构介绍。
 bool CInfo::get_process_info(process_info_t* process_info, pid_t pid)
 {
     char filename[FILENAME_MAX];
     snprintf(filename, sizeof(filename), "/proc/%u/stat", pid);
-    FILE* fp = fopen(filename, "r");
 
-    do
-    {
-        if (NULL == fp) break;
-
-        char line[LINE_MAX];
-        const int filed_number = 38;
-        const char* linep = fgets(line, sizeof(line)-1, fp);
-        if (NULL == linep) break;
-
-        process_info_t pi;
-        const int num = sscanf(line, "%d%s%s%d%d"
-                             "%d%d%d%u%" PRIu64
-                             "%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64
-                             "%" PRId64"%" PRId64"%" PRId64"%" PRId64"%" PRId64
-                             "%" PRId64"%" PRId64"%" PRIu64"%" PRId64"%" PRIu64
-                             "%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64
-                             "%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64
-                             "%" PRIu64"%d%d"
-                  /** 01 */ ,&pi.pid
-                  /** 02 */ , pi.comm
-                  /** 03 */ ,&pi.state
-                  /** 04 */ ,&pi.ppid
-                  /** 05 */ ,&pi.pgrp
-                  /** 06 */ ,&pi.session
-                  /** 07 */ ,&pi.tty_nr
-                  /** 08 */ ,&pi.tpgid
-                  /** 09 */ ,&pi.flags
-                  /** 10 */ ,&pi.minflt
-                  /** 11 */ ,&pi.cminflt
-                  /** 12 */ ,&pi.majflt
-                  /** 13 */ ,&pi.cmajflt
-                  /** 14 */ ,&pi.utime
-                  /** 15 */ ,&pi.stime
-                  /** 16 */ ,&pi.cutime
-                  /** 17 */ ,&pi.cstime
-                  /** 18 */ ,&pi.priority
-                  /** 19 */ ,&pi.nice
-                  /** 20 */ ,&pi.num_threads
-                  /** 21 */ ,&pi.itrealvalue
-                  /** 22 */ ,&pi.starttime
-                  /** 23 */ ,&pi.vsize
-                  /** 24 */ ,&pi.rss
-                  /** 25 */ ,&pi.rlim
-                  /** 26 */ ,&pi.startcode
-                  /** 27 */ ,&pi.endcode
-                  /** 28 */ ,&pi.startstack
-                  /** 29 */ ,&pi.kstkesp
-                  /** 30 */ ,&pi.kstkeip
-                  /** 31 */ ,&pi.signal
-                  /** 32 */ ,&pi.blocked
-                  /** 33 */ ,&pi.sigignore
-                  /** 34 */ ,&pi.sigcatch
-                  /** 35 */ ,&pi.nswap
-                  /** 36 */ ,&pi.cnswap
-                  /** 37 */ ,&pi.exit_signal
-                  /** 38 */ ,&pi.processor);
-
-        if (num == filed_number)
-        {
-            memcpy(process_info, &pi, sizeof(pi));
-        }
-
-        fclose(fp);
-        return (num == filed_number);
-    } while(false);
+    CProcFile file;
+    if (!file.open(filename)) return false;
+    const char* text = file.read();
+    if (NULL == text) return false;
 
-    if (fp != NULL)
-        fclose(fp);
-    return false;
+    process_info_t pi;
+    if (!parse_process_stat(text, &pi)) return false;
+    memcpy(process_info, &pi, sizeof(pi));
+    return true;
 }
 
 bool CInfo::get_process_page_info(process_page_info_t& process_page_info)
@@ -343,24 +465,21 @@ bool CInfo::get_process_page_info(process_page_info_t& process_page_info, pid_t
     char filename[FILENAME_MAX];
     snprintf(filename, sizeof(filename), "/proc/%u/statm", pid);
 
-    FILE* fp = fopen(filename, "r");
-    if (NULL == fp) return false;
-    sys::CloseHelper<FILE*> ch(fp);
-
-    char line[LINE_MAX];
-    int filed_number = 6;
-	char* linep = fgets(line, sizeof(line)-1, fp);
+    CProcFile file;
+    if (!file.open(filename)) return false;
+    const char* text = file.read();
+    if (NULL == text) return false;
 
-    if (NULL == linep) return false;
+    uint64_t v[6];
+    if (NULL == parse_numbers(text, v, 6)) return false;
 
-    return (sscanf(line
-                  ,"%" PRId64"%" PRId64"%" PRId64"%" PRId64"%" PRId64"%" PRId64
-                  ,&process_page_info.size
-                  ,&process_page_info.resident
-                  ,&process_page_info.share
-                  ,&process_page_info.text
-                  ,&process_page_info.lib
-                  ,&process_page_info.data) == filed_number);
+    process_page_info.size     = static_cast<int64_t>(v[0]);
+    process_page_info.resident = static_cast<int64_t>(v[1]);
+    process_page_info.share    = static_cast<int64_t>(v[2]);
+    process_page_info.text     = static_cast<int64_t>(v[3]);
+    process_page_info.lib      = static_cast<int64_t>(v[4]);
+    process_page_info.data     = static_cast<int64_t>(v[5]);
+    return true;
 }
 
 // getrusage
@@ -378,70 +497,94 @@ bool CInfo::get_process_times(process_time_t& process_time)
     return true;
 }
 
-// 在Centos Linux上执行：info proc，
-// 可以搜索到关于文件“/proc/net/dev”的结构介绍。
-bool CInfo::do_get_net_info_array(const char* interface_name, std::vector<net_info_t>& net_info_array)
+CInfo::TThreadTimes::TThreadTimes()
+    : user_microseconds(0), system_microseconds(0), voluntary_switches(0), involuntary_switches(0),
+      run_nanoseconds(0), run_delay_nanoseconds(0)
 {
-    net_info_array.clear();
-    
-    FILE* fp = fopen("/proc/net/dev", "r");
-    if (NULL == fp) return false;
-    sys::CloseHelper<FILE*> ch(fp);
+}
 
-    char line[LINE_MAX];
-    int filed_number = 17;
+// schedstat的内容为：运行纳秒数 运行队列中等待的纳秒数 时间片数
+static void read_schedstat(const char* filename, CInfo::thread_times_t& thread_times)
+{
+    CProcFile file;
+    uint64_t values[2];
+    const char* text = file.open(filename)? file.read(): NULL;
+    if ((text != NULL) && (parse_numbers(text, values, 2) != NULL))
+    {
+        thread_times.run_nanoseconds = values[0];
+        thread_times.run_delay_nanoseconds = values[1];
+    }
+}
 
-    // 跳过头两行
-    if (NULL == fgets(line, sizeof(line)-1, fp)) return false;
-    if (NULL == fgets(line, sizeof(line)-1, fp)) return false;
+bool CInfo::get_current_thread_times(thread_times_t& thread_times)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) return false;
+
+    thread_times.user_microseconds = usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec;
+    thread_times.system_microseconds = usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+    thread_times.voluntary_switches = usage.ru_nvcsw;
+    thread_times.involuntary_switches = usage.ru_nivcsw;
+    read_schedstat("/proc/thread-self/schedstat", thread_times);
+    return true;
+}
 
-    while (fgets(line, sizeof(line)-1, fp))
+bool CInfo::get_thread_times(uint32_t tid, thread_times_t& thread_times)
+{
+    char filename[64];
+    CProcFile file;
+
+    // stat中线程名可能含空格和括号，从最后一个')'之后开始，依次为第3个字段state、第4个字段ppid……，
+    // 第14和15个字段为utime和stime，单位为时钟滴答
+    snprintf(filename, sizeof(filename), "/proc/self/task/%u/stat", tid);
+    const char* text = file.open(filename)? file.read(): NULL;
+    const char* p = (NULL == text)? NULL: strrchr(text, ')');
+    if ((NULL == p) || ('\0' == p[1]) || ('\0' == p[2])) return false;
+
+    uint64_t values[12];
+    if (NULL == parse_numbers(skip_blank(p+1)+1, values, 12)) return false;
+    const uint64_t ticks_per_second = sysconf(_SC_CLK_TCK);
+    thread_times.user_microseconds = values[10] * 1000000 / ticks_per_second;
+    thread_times.system_microseconds = values[11] * 1000000 / ticks_per_second;
+
+    snprintf(filename, sizeof(filename), "/proc/self/task/%u/status", tid);
+    text = file.open(filename)? file.read(): NULL;
+    if (text != NULL)
     {
-        char* line_p = line;
-        // 去掉前导空格
-        while ((' ' == *line_p) || ('\t' == *line_p))
-            ++line_p;
-        
-        char* colon = strchr(line_p, ':');
-        if (NULL == colon) break;
-        *colon = '\t';
+        for (const char* line=text; line!=NULL; line=next_line(line))
+        {
+            if (0 == strncmp(line, "voluntary_ctxt_switches:", sizeof("voluntary_ctxt_switches:")-1))
+                (void)parse_number(line+sizeof("voluntary_ctxt_switches:")-1, &thread_times.voluntary_switches);
+            else if (0 == strncmp(line, "nonvoluntary_ctxt_switches:", sizeof("nonvoluntary_ctxt_switches:")-1))
+                (void)parse_number(line+sizeof("nonvoluntary_ctxt_switches:")-1, &thread_times.involuntary_switches);
+        }
+    }
 
-        if ((interface_name != NULL)
-         && (strncmp(line_p, interface_name, strlen(interface_name)) != 0))
-            continue;
-        
-        net_info_t net_info;
-        if (sscanf(line_p
-                      ,"%s"
-                       "%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64
-                       "%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64
-                       "%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64"%" PRIu64
-                       "%" PRIu64
-            /** 01 */ , net_info.interface_name
-            /** 02 */ ,&net_info.receive_bytes
-            /** 03 */ ,&net_info.receive_packets
-            /** 04 */ ,&net_info.receive_errors
-            /** 05 */ ,&net_info.receive_dropped
-            /** 06 */ ,&net_info.receive_fifo_errors
-            /** 07 */ ,&net_info.receive_frame
-            /** 08 */ ,&net_info.receive_compressed
-            /** 09 */ ,&net_info.receive_multicast
-            /** 10 */ ,&net_info.transmit_bytes
-            /** 11 */ ,&net_info.transmit_packets
-            /** 12 */ ,&net_info.transmit_errors
-            /** 13 */ ,&net_info.transmit_dropped
-            /** 14 */ ,&net_info.transmit_fifo_errors
-            /** 15 */ ,&net_info.transmit_collisions
-            /** 16 */ ,&net_info.transmit_carrier
-            /** 17 */ ,&net_info.transmit_compressed
-                      ) != filed_number)
-            break;
+    snprintf(filename, sizeof(filename), "/proc/self/task/%u/schedstat", tid);
+    read_schedstat(filename, thread_times);
+    return true;
+}
 
-        net_info_array.push_back(net_info);
-        return true;
-    }
+uint32_t CInfo::get_current_tid()
+{
+    return static_cast<uint32_t>(syscall(SYS_gettid));
+}
 
-    return false;
+// 在Centos Linux上执行：info proc，
+
+// 在Centos Linux上执行：info proc，
+// 可以搜索到关于文件“/proc/net/dev”的结构介绍。
+bool CInfo::do_get_net_info_array(const char* interface_name, std::vector<net_info_t>& net_info_array)
+{
+    net_info_array.clear();
+
+    CProcFile file;
+    if (!file.open("/proc/net/dev")) return false;
+    const char* text = file.read();
+    if (NULL == text) return false;
+
+    parse_net_dev(text, interface_name, &net_info_array);
+    return !net_info_array.empty();
 }
 
 bool CInfo::get_net_info(const char* interface_name, net_info_t& net_info)
@@ -461,4 +604,371 @@ bool CInfo::get_net_info_array(std::vector<net_info_t>& net_info_array)
     return do_get_net_info_array(NULL, net_info_array);
 }
 
+CProcFile::CProcFile()
+    : _fd(-1), _buffer(NULL), _buffer_size(0)
+{
+}
+
+CProcFile::~CProcFile()
+{
+    close();
+    free(_buffer);
+}
+
+bool CProcFile::open(const char* filename)
+{
+    close();
+    _fd = ::open(filename, O_RDONLY|O_CLOEXEC);
+    return _fd != -1;
+}
+
+void CProcFile::close()
+{
+    if (_fd != -1)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+const char* CProcFile::read(size_t* size)
+{
+    if (-1 == _fd)
+        return NULL;
+
+    size_t offset = 0;
+    for (;;)
+    {
+        // 总是保留一个字节存放结尾符
+        if (offset + 1 >= _buffer_size)
+        {
+            const size_t buffer_size = (0 == _buffer_size)? SIZE_4K: _buffer_size * 2;
+            char* buffer = static_cast<char*>(realloc(_buffer, buffer_size));
+            if (NULL == buffer)
+                return NULL;
+            _buffer = buffer;
+            _buffer_size = buffer_size;
+        }
+
+        const ssize_t bytes = pread(_fd, _buffer+offset, _buffer_size-offset-1, static_cast<off_t>(offset));
+        if (bytes > 0)
+            offset += bytes;
+        else if (0 == bytes)
+            break;
+        else if (errno != EINTR)
+            return NULL;
+    }
+
+    _buffer[offset] = '\0';
+    if (size != NULL)
+        *size = offset;
+    return _buffer;
+}
+
+CInfoSampler::TResourceRates::TResourceRates()
+{
+    interval_milliseconds = 0;
+    cpu_percent = 0;
+    cpu_iowait_percent = 0;
+    context_switches = 0;
+    process_cpu_percent = 0;
+    process_context_switches = 0;
+    process_vsize = 0;
+    process_rss = 0;
+}
+
+CInfoSampler::CInfoSampler()
+    : _page_size(sysconf(_SC_PAGESIZE)), _last_microseconds(0), _last_context_switches(0),
+      _last_process_cpu_microseconds(0), _last_process_context_switches(0)
+{
+}
+
+bool CInfoSampler::sample(resource_rates_t* rates)
+{
+    const uint64_t now = CClock::get_microseconds();
+    const bool has_baseline = (_last_microseconds != 0) && (now > _last_microseconds);
+    const double seconds = has_baseline? (now - _last_microseconds) / 1000000.0: 0;
+
+    rates->interval_milliseconds = has_baseline? (now - _last_microseconds) / 1000: 0;
+    const bool ok = sample_cpu(seconds, rates);
+    sample_process(seconds, rates);
+    sample_net(seconds, rates);
+
+    _last_microseconds = now;
+    return ok && has_baseline;
+}
+
+// 速率只在有基线（seconds大于0）时计算，计数器变小（如CPU热插拔或网卡重建）时为0
+static double get_rate(uint64_t current, uint64_t last, double seconds)
+{
+    return ((seconds > 0) && (current >= last))? (current - last) / seconds: 0;
+}
+
+static double get_percent(uint64_t current, uint64_t last, uint64_t current_total, uint64_t last_total)
+{
+    return ((current >= last) && (current_total > last_total))? 100.0 * (current - last) / (current_total - last_total): 0;
+}
+
+bool CInfoSampler::sample_cpu(double seconds, resource_rates_t* rates)
+{
+    if (!_stat_file.is_open() && !_stat_file.open("/proc/stat"))
+        return false;
+    const char* text = _stat_file.read();
+    if (NULL == text)
+        return false;
+
+    // 离线的CPU不在/proc/stat中，对应的位置保持为0
+    std::vector<CpuTimes> cpu_times;
+    uint64_t context_switches = _last_context_switches;
+    for (const char* line=text; line!=NULL; line=next_line(line))
+    {
+        uint64_t values[7];
+        int cpu_index;
+        if (parse_cpu_line(line, values, &cpu_index))
+        {
+            const size_t index = static_cast<size_t>(cpu_index + 1);
+            if (index >= cpu_times.size())
+            {
+                const CpuTimes zero = { 0, 0, 0 };
+                cpu_times.resize(index+1, zero);
+            }
+
+            CpuTimes& times = cpu_times[index];
+            times.total = values[0] + values[1] + values[2] + values[3] + values[4] + values[5] + values[6];
+            times.iowait = values[4];
+            times.busy = times.total - values[3] - values[4];
+        }
+        else if (0 == strncmp(line, "ctxt ", 5))
+        {
+            (void)parse_number(line+5, &context_switches);
+        }
+    }
+    if (cpu_times.empty())
+        return false;
+
+    rates->cpu_percent_array.clear();
+    if (seconds > 0)
+    {
+        for (size_t i=0; (i<cpu_times.size()) && (i<_last_cpu_times.size()); ++i)
+        {
+            const CpuTimes& current = cpu_times[i];
+            const CpuTimes& last = _last_cpu_times[i];
+            const double percent = get_percent(current.busy, last.busy, current.total, last.total);
+
+            if (0 == i)
+            {
+                rates->cpu_percent = percent;
+                rates->cpu_iowait_percent = get_percent(current.iowait, last.iowait, current.total, last.total);
+            }
+            else
+            {
+                rates->cpu_percent_array.push_back(percent);
+            }
+        }
+
+        rates->context_switches = get_rate(context_switches, _last_context_switches, seconds);
+    }
+
+    _last_cpu_times.swap(cpu_times);
+    _last_context_switches = context_switches;
+    return true;
+}
+
+void CInfoSampler::sample_process(double seconds, resource_rates_t* rates)
+{
+    // getrusage比读/proc/self/stat更轻，且CPU时间精确到微秒
+    struct rusage usage;
+    if (0 == getrusage(RUSAGE_SELF, &usage))
+    {
+        const uint64_t cpu_microseconds = usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec
+                                        + usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+        const uint64_t context_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+
+        rates->process_cpu_percent = get_rate(cpu_microseconds, _last_process_cpu_microseconds, seconds) / 10000.0;
+        rates->process_context_switches = get_rate(context_switches, _last_process_context_switches, seconds);
+        _last_process_cpu_microseconds = cpu_microseconds;
+        _last_process_context_switches = context_switches;
+    }
+
+    if (_statm_file.is_open() || _statm_file.open("/proc/self/statm"))
+    {
+        uint64_t v[2];
+        const char* text = _statm_file.read();
+        if ((text != NULL) && (parse_numbers(text, v, 2) != NULL))
+        {
+            rates->process_vsize = v[0] * _page_size;
+            rates->process_rss = v[1] * _page_size;
+        }
+    }
+}
+
+void CInfoSampler::sample_net(double seconds, resource_rates_t* rates)
+{
+    if (!_net_dev_file.is_open() && !_net_dev_file.open("/proc/net/dev"))
+        return;
+    const char* text = _net_dev_file.read();
+    if (NULL == text)
+        return;
+
+    std::vector<CInfo::net_info_t> net_info_array;
+    parse_net_dev(text, NULL, &net_info_array);
+
+    rates->net_rate_array.clear();
+    for (size_t i=0; (seconds>0) && (i<net_info_array.size()); ++i)
+    {
+        const CInfo::net_info_t& current = net_info_array[i];
+
+        // 网卡通常不多，且两次采样的顺序一般不变，优先从同一位置开始比较
+        const CInfo::net_info_t* last = NULL;
+        for (size_t j=0; j<_last_net_info_array.size(); ++j)
+        {
+            const CInfo::net_info_t& candidate = _last_net_info_array[(i+j) % _last_net_info_array.size()];
+            if (0 == strcmp(candidate.interface_name, current.interface_name))
+            {
+                last = &candidate;
+                break;
+            }
+        }
+        if (NULL == last)
+            continue;
+
+        net_rate_t net_rate;
+        memcpy(net_rate.interface_name, current.interface_name, sizeof(net_rate.interface_name));
+        net_rate.receive_bytes = get_rate(current.receive_bytes, last->receive_bytes, seconds);
+        net_rate.receive_packets = get_rate(current.receive_packets, last->receive_packets, seconds);
+        net_rate.transmit_bytes = get_rate(current.transmit_bytes, last->transmit_bytes, seconds);
+        net_rate.transmit_packets = get_rate(current.transmit_packets, last->transmit_packets, seconds);
+        rates->net_rate_array.push_back(net_rate);
+    }
+
+    _last_net_info_array.swap(net_info_array);
+}
+
+static void set_gauge(const std::string& name, double value)
+{
+    CMetricsRegistry::get_singleton()->get_gauge(name)->set(static_cast<int64_t>(value + 0.5));
+}
+
+void CInfoSampler::publish_metrics(const resource_rates_t& rates)
+{
+    set_gauge("system.cpu_permille", rates.cpu_percent * 10);
+    set_gauge("system.cpu_iowait_permille", rates.cpu_iowait_percent * 10);
+    set_gauge("system.context_switches_per_second", rates.context_switches);
+    set_gauge("process.cpu_permille", rates.process_cpu_percent * 10);
+    set_gauge("process.context_switches_per_second", rates.process_context_switches);
+    set_gauge("process.vsize_bytes", static_cast<double>(rates.process_vsize));
+    set_gauge("process.rss_bytes", static_cast<double>(rates.process_rss));
+
+    for (std::vector<net_rate_t>::size_type i=0; i<rates.net_rate_array.size(); ++i)
+    {
+        const net_rate_t& net_rate = rates.net_rate_array[i];
+        const std::string prefix = std::string("net.") + net_rate.interface_name;
+        set_gauge(prefix + ".receive_bytes_per_second", net_rate.receive_bytes);
+        set_gauge(prefix + ".receive_packets_per_second", net_rate.receive_packets);
+        set_gauge(prefix + ".transmit_bytes_per_second", net_rate.transmit_bytes);
+        set_gauge(prefix + ".transmit_packets_per_second", net_rate.transmit_packets);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 登记的线程，键为tid，线程启动和退出时才修改，以互斥锁保护即可
+static pthread_mutex_t sg_thread_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint32_t, std::string>* sg_thread_registry = new std::map<uint32_t, std::string>;
+
+CThreadSampler::TThreadRates::TThreadRates()
+    : tid(0), cpu_percent(0), run_delay_percent(0), voluntary_switches(0), involuntary_switches(0)
+{
+}
+
+void CThreadSampler::register_current_thread(const std::string& name)
+{
+    const uint32_t tid = CInfo::get_current_tid();
+    pthread_mutex_lock(&sg_thread_registry_mutex);
+    (*sg_thread_registry)[tid] = name;
+    pthread_mutex_unlock(&sg_thread_registry_mutex);
+}
+
+void CThreadSampler::unregister_current_thread()
+{
+    const uint32_t tid = CInfo::get_current_tid();
+    pthread_mutex_lock(&sg_thread_registry_mutex);
+    sg_thread_registry->erase(tid);
+    pthread_mutex_unlock(&sg_thread_registry_mutex);
+}
+
+size_t CThreadSampler::get_registered_number()
+{
+    pthread_mutex_lock(&sg_thread_registry_mutex);
+    const size_t number = sg_thread_registry->size();
+    pthread_mutex_unlock(&sg_thread_registry_mutex);
+    return number;
+}
+
+CThreadSampler::CThreadSampler()
+    : _last_microseconds(0)
+{
+}
+
+bool CThreadSampler::sample(std::vector<thread_rates_t>* rates_array)
+{
+    // 读/proc时不持锁，线程在此期间退出时读取失败，跳过即可
+    std::map<uint32_t, std::string> threads;
+    pthread_mutex_lock(&sg_thread_registry_mutex);
+    threads = *sg_thread_registry;
+    pthread_mutex_unlock(&sg_thread_registry_mutex);
+
+    const uint64_t now = CClock::get_microseconds();
+    const bool has_baseline = (_last_microseconds != 0) && (now > _last_microseconds);
+    const double seconds = has_baseline? (now - _last_microseconds) / 1000000.0: 0;
+
+    std::map<uint32_t, CInfo::thread_times_t> times;
+    rates_array->clear();
+    for (std::map<uint32_t, std::string>::const_iterator iter=threads.begin(); iter!=threads.end(); ++iter)
+    {
+        CInfo::thread_times_t& current = times[iter->first];
+        if (!CInfo::get_thread_times(iter->first, current))
+        {
+            times.erase(iter->first);
+            continue;
+        }
+
+        std::map<uint32_t, CInfo::thread_times_t>::const_iterator last_iter = _last_times.find(iter->first);
+        if ((seconds <= 0) || (last_iter == _last_times.end()))
+            continue;
+
+        // 有schedstat时以其纳秒级的运行时间计算CPU使用率，否则以时钟滴答精度的stat
+        const CInfo::thread_times_t& last = last_iter->second;
+        thread_rates_t rates;
+        rates.tid = iter->first;
+        rates.name = iter->second;
+        if (current.run_nanoseconds > last.run_nanoseconds)
+            rates.cpu_percent = get_rate(current.run_nanoseconds, last.run_nanoseconds, seconds) / 10000000.0;
+        else
+            rates.cpu_percent = get_rate(current.user_microseconds + current.system_microseconds,
+                                         last.user_microseconds + last.system_microseconds, seconds) / 10000.0;
+        rates.run_delay_percent = get_rate(current.run_delay_nanoseconds, last.run_delay_nanoseconds, seconds) / 10000000.0;
+        rates.voluntary_switches = get_rate(current.voluntary_switches, last.voluntary_switches, seconds);
+        rates.involuntary_switches = get_rate(current.involuntary_switches, last.involuntary_switches, seconds);
+        rates_array->push_back(rates);
+    }
+
+    // 已注销的线程不再保留基线
+    _last_times.swap(times);
+    _last_microseconds = now;
+    return has_baseline;
+}
+
+void CThreadSampler::publish_metrics(const std::vector<thread_rates_t>& rates_array)
+{
+    for (std::vector<thread_rates_t>::size_type i=0; i<rates_array.size(); ++i)
+    {
+        const thread_rates_t& rates = rates_array[i];
+        const std::string prefix = "thread." + rates.name;
+        set_gauge(prefix + ".cpu_permille", rates.cpu_percent * 10);
+        set_gauge(prefix + ".run_delay_permille", rates.run_delay_percent * 10);
+        set_gauge(prefix + ".voluntary_switches_per_second", rates.voluntary_switches);
+        set_gauge(prefix + ".involuntary_switches_per_second", rates.involuntary_switches);
+    }
+}
+
 SYS_NAMESPACE_END
@@ -19,9 +19,11 @@
 #include <time.h>
 #include <sys/time.h>
 #include "sys/lock.h"
+#include "sys/profiler.h"
 SYS_NAMESPACE_BEGIN
 
 CLock::CLock(bool recursive)
+    : _contention_name(NULL), _contention(NULL)
 {
     int errcode = 0;
     if (recursive)
@@ -65,6 +67,12 @@ CLock::~CLock()
 
 void CLock::lock()
 {
+    if ((_contention_name != NULL) && CLockProfiler::is_enabled())
+    {
+        profiled_lock();
+        return;
+    }
+
     int errcode = pthread_mutex_lock(&_mutex);
     if (errcode != 0)
         THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_lock");
@@ -87,6 +95,26 @@ bool CLock::try_lock()
 	THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_trylock");
 }
 
+// 先try_lock，取不到时才计时等待
+void CLock::profiled_lock()
+{
+    if (try_lock())
+        return;
+
+    CLockContention* contention = __atomic_load_n(&_contention, __ATOMIC_ACQUIRE);
+    if (NULL == contention)
+    {
+        contention = CLockProfiler::get_contention(_contention_name);
+        __atomic_store_n(&_contention, contention, __ATOMIC_RELEASE);
+    }
+
+    const uint64_t start_ns = CLockProfiler::begin_wait(contention);
+    int errcode = pthread_mutex_lock(&_mutex);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_lock");
+    CLockProfiler::end_wait(contention, start_ns);
+}
+
 bool CLock::timed_lock(uint32_t millisecond)
 {
 	int errcode;
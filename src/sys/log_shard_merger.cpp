@@ -0,0 +1,138 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/log_shard_merger.h"
+#include "sys/dir_utils.h"
+#include <algorithm>
+#include <map>
+#include <stdlib.h>
+SYS_NAMESPACE_BEGIN
+
+CLogShardMerger::CLogShardMerger(const std::string& log_dir, const std::string& log_filename)
+{
+    const std::string prefix = log_filename + std::string(".shard.");
+    std::vector<std::string> file_names;
+    std::map<std::string, std::vector<std::pair<uint32_t, std::string> > > segments; // 分片到(段号, 路径)
+
+    CDirUtils::list(log_dir, NULL, &file_names);
+    for (std::vector<std::string>::size_type i=0; i<file_names.size(); ++i)
+    {
+        // 去掉前缀后为<pid>.<tid>.<birth>.<segment>
+        const std::string& file_name = file_names[i];
+        if (file_name.compare(0, prefix.size(), prefix) != 0)
+            continue;
+        const std::string::size_type dot = file_name.rfind('.');
+        if ((dot == std::string::npos) || (dot < prefix.size()))
+            continue;
+
+        const std::string shard_name = file_name.substr(prefix.size(), dot - prefix.size());
+        const uint32_t segment = static_cast<uint32_t>(strtoul(file_name.c_str() + dot + 1, NULL, 10));
+        segments[shard_name].push_back(std::make_pair(segment, log_dir + std::string("/") + file_name));
+    }
+
+    for (std::map<std::string, std::vector<std::pair<uint32_t, std::string> > >::iterator iter=segments.begin(); iter!=segments.end(); ++iter)
+    {
+        std::vector<std::pair<uint32_t, std::string> >& shard_segments = iter->second;
+        std::sort(shard_segments.begin(), shard_segments.end());
+
+        Shard* shard = new Shard;
+        shard->segment_index = 0;
+        shard->fp = NULL;
+        shard->timestamp = 0;
+        for (std::vector<std::pair<uint32_t, std::string> >::size_type i=0; i<shard_segments.size(); ++i)
+            shard->segment_paths.push_back(shard_segments[i].second);
+        _shards.push_back(shard);
+
+        if (read_record(shard))
+        {
+            Head head;
+            head.timestamp = shard->timestamp;
+            head.index = _shards.size() - 1;
+            _heads.push(head);
+        }
+    }
+}
+
+CLogShardMerger::~CLogShardMerger()
+{
+    for (std::vector<Shard*>::size_type i=0; i<_shards.size(); ++i)
+    {
+        if (_shards[i]->fp != NULL)
+            fclose(_shards[i]->fp);
+        delete _shards[i];
+    }
+}
+
+bool CLogShardMerger::next(std::string* log_line, uint64_t* timestamp)
+{
+    if (_heads.empty())
+        return false;
+
+    Head head = _heads.top();
+    Shard* shard = _shards[head.index];
+    _heads.pop();
+    log_line->swap(shard->log_line);
+    if (timestamp != NULL)
+        *timestamp = shard->timestamp;
+
+    if (read_record(shard))
+    {
+        head.timestamp = shard->timestamp;
+        _heads.push(head);
+    }
+    return true;
+}
+
+// 读分片的下一条记录，当前段读完或有不完整的记录时读下一段
+bool CLogShardMerger::read_record(Shard* shard)
+{
+    while (shard->segment_index < shard->segment_paths.size())
+    {
+        if (NULL == shard->fp)
+        {
+            shard->fp = fopen(shard->segment_paths[shard->segment_index].c_str(), "r");
+            if (NULL == shard->fp)
+            {
+                // 可能已被写入者删除
+                ++shard->segment_index;
+                continue;
+            }
+        }
+
+        unsigned long long timestamp, sequence;
+        int size;
+        // 长度后只有一个空格，日志行本身可能以空白开头
+        if ((3 == fscanf(shard->fp, "%llu %llu %d", &timestamp, &sequence, &size)) && (size >= 0) && (' ' == fgetc(shard->fp)))
+        {
+            shard->log_line.resize(size);
+            if ((0 == size) || (1 == fread(&shard->log_line[0], size, 1, shard->fp)))
+            {
+                shard->timestamp = timestamp;
+                return true;
+            }
+        }
+
+        fclose(shard->fp);
+        shard->fp = NULL;
+        ++shard->segment_index;
+    }
+
+    return false;
+}
+
+SYS_NAMESPACE_END
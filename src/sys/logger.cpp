@@ -19,6 +19,9 @@
 #include "sys/logger.h"
 #include "sys/datetime_utils.h"
 #include "sys/dir_utils.h"
+#include "sys/mem_tracker.h"
+#include "sys/metrics.h"
+#include "sys/rate_limiter.h"
 #include "sys/utils.h"
 #include "utils/string_utils.h"
 #include <stdarg.h>
@@ -33,9 +36,207 @@
 #define LOG_FLAG_TEXT 0x02
 SYS_NAMESPACE_BEGIN
 
+// 所有Logger共用的度量，write_ns为一次write或writev的耗时，backlog为队列中还未写的日志条数
+static CGauge* get_backlog_gauge()
+{
+    static CGauge* gauge = CMetricsRegistry::get_singleton()->get_gauge("logger.backlog");
+    return gauge;
+}
+
+// 队列中还未写的日志槽占用的内存
+static CMemTracker* get_mem_tracker()
+{
+    static CMemTracker* tracker = CMemTracker::get_tracker("logger");
+    return tracker;
+}
+
+static CCounter* get_lines_counter()
+{
+    static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("logger.lines");
+    return counter;
+}
+
+static CCounter* get_dropped_counter()
+{
+    static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("logger.dropped");
+    return counter;
+}
+
+// sink_sent为发给ILogSink的日志条数，sink_fallback为sink失败后改写本地文件的条数
+static CCounter* get_sink_sent_counter()
+{
+    static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("logger.sink_sent");
+    return counter;
+}
+
+static CCounter* get_sink_fallback_counter()
+{
+    static CCounter* counter = CMetricsRegistry::get_singleton()->get_counter("logger.sink_fallback");
+    return counter;
+}
+
+static CLatencyHistogram* get_write_histogram()
+{
+    static CLatencyHistogram* histogram = CMetricsRegistry::get_singleton()->get_histogram("logger.write_ns");
+    return histogram;
+}
+
+// 每个线程一个的日志行格式化缓冲区，线程首次写日志时分配，线程退出时释放
+static pthread_once_t sg_line_buffer_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sg_line_buffer_key;
+
+static void free_line_buffer(void* line_buffer)
+{
+    delete [](char*)line_buffer;
+}
+
+static void create_line_buffer_key()
+{
+    (void)pthread_key_create(&sg_line_buffer_key, free_line_buffer);
+}
+
+static char* get_line_buffer()
+{
+    (void)pthread_once(&sg_line_buffer_once, create_line_buffer_key);
+
+    char* line_buffer = static_cast<char*>(pthread_getspecific(sg_line_buffer_key));
+    if (NULL == line_buffer)
+    {
+        // 多出的2个字节用于自动添加的点号和换行符
+        line_buffer = new char[LOG_LINE_SIZE_MAX+2];
+        (void)pthread_setspecific(sg_line_buffer_key, line_buffer);
+    }
+
+    return line_buffer;
+}
+
 // 在sys/log.h中声明
 ILogger* g_logger = NULL;
 bool g_null_print_screen = false; // 当g_logger为空时是否打屏
+ILogger* g_log_level_logger = NULL;
+int g_log_level = LOG_LEVEL_DETAIL;
+uint32_t g_log_module_masks[LOG_MODULE_NUMBER_MAX];
+const char* g_log_module_names[LOG_MODULE_NUMBER_MAX];
+static uint16_t sg_log_module_number = 1; // 模块0为默认模块
+static CLock sg_log_module_lock;
+
+// 先取消发布再更新级别，读者不会把新的日志器和旧的级别配在一起
+void publish_log_level(ILogger* logger)
+{
+    if ((NULL == logger) || (logger != g_logger))
+        return;
+
+    __atomic_store_n(&g_log_level_logger, static_cast<ILogger*>(NULL), __ATOMIC_RELEASE);
+    const int log_level = logger->get_log_level();
+    if (log_level != -1)
+    {
+        __atomic_store_n(&g_log_level, log_level, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_log_level_logger, logger, __ATOMIC_RELEASE);
+    }
+}
+
+void unpublish_log_level(ILogger* logger)
+{
+    ILogger* expected = logger;
+    (void)__atomic_compare_exchange_n(&g_log_level_logger, &expected, static_cast<ILogger*>(NULL), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+log_module_t register_log_module(const char* name)
+{
+    LockHelper<CLock> lock_helper(sg_log_module_lock);
+    for (uint16_t i=1; i<sg_log_module_number; ++i)
+    {
+        if (0 == strcmp(g_log_module_names[i], name))
+            return i;
+    }
+    if (sg_log_module_number >= LOG_MODULE_NUMBER_MAX)
+        return 0;
+
+    const log_module_t module = sg_log_module_number++;
+    g_log_module_names[module] = name;
+    __atomic_store_n(&g_log_module_masks[module], ~static_cast<uint32_t>(0), __ATOMIC_RELAXED);
+    return module;
+}
+
+void set_log_module_mask(log_module_t module, uint32_t mask)
+{
+    if ((module > 0) && (module < LOG_MODULE_NUMBER_MAX))
+        __atomic_store_n(&g_log_module_masks[module], mask, __ATOMIC_RELAXED);
+}
+
+void set_log_module_level(log_module_t module, log_level_t log_level)
+{
+    set_log_module_mask(module, ~static_cast<uint32_t>(0) << log_level);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CLogRepeatFilter::CLogRepeatFilter()
+    : _enabled(false), _last_hash(0), _last_level(LOG_LEVEL_INFO), _repeated_number(0), _report_seconds(0)
+{
+}
+
+bool CLogRepeatFilter::filter(log_level_t log_level, const char* filename, int lineno, const char* content, size_t content_size,
+                              uint32_t* repeated_number, log_level_t* repeated_level)
+{
+    if (!_enabled)
+    {
+        *repeated_number = 0;
+        return false;
+    }
+
+    // FNV-1a，再混入级别和代码位置
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i=0; i<content_size; ++i)
+        hash = (hash ^ static_cast<unsigned char>(content[i])) * 1099511628211ULL;
+    hash ^= (static_cast<uint64_t>(log_level) << 56) ^ (static_cast<uint64_t>(lineno) << 32) ^ reinterpret_cast<uintptr_t>(filename);
+
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    const uint64_t now_seconds = static_cast<uint64_t>(ts.tv_sec);
+
+    LockHelper<CAdaptiveLock> lock_helper(_lock);
+    if ((hash == _last_hash) && (now_seconds < _report_seconds + LOG_REPEAT_REPORT_SECONDS))
+    {
+        ++_repeated_number;
+        return true;
+    }
+
+    *repeated_number = _repeated_number;
+    *repeated_level = _last_level;
+    _last_hash = hash;
+    _last_level = log_level;
+    _repeated_number = 0;
+    _report_seconds = now_seconds;
+    return false;
+}
+
+uint32_t CLogRepeatFilter::take_repeated(log_level_t* repeated_level)
+{
+    LockHelper<CAdaptiveLock> lock_helper(_lock);
+    const uint32_t repeated_number = _repeated_number;
+    *repeated_level = _last_level;
+    _repeated_number = 0;
+    _last_hash = 0;
+    return repeated_number;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CLogSiteLimit::CLogSiteLimit(uint32_t rate, uint32_t burst)
+    : _token_bucket(new CTokenBucket((0 == rate)? 1: rate, burst)), _suppressed_number(0)
+{
+}
+
+bool CLogSiteLimit::allow(uint32_t* suppressed_number)
+{
+    if (!_token_bucket->try_acquire())
+    {
+        (void)__atomic_add_fetch(&_suppressed_number, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *suppressed_number = __atomic_exchange_n(&_suppressed_number, 0, __ATOMIC_RELAXED);
+    return true;
+}
 
 /** 日志级别名称数组，最大名称长度为8个字符，如果长度不够，编译器会报错 */
 static char log_level_name_array[][8] = { "DETAIL", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "STATE", "TRACE", "RAW", "BIN" };
@@ -196,7 +397,7 @@ void CLogProber::send_signal()
 
 void CLogProber::read_signal(int signal_number)
 {
-    char signals[LOG_NUMBER_WRITED_ONCE];
+    char signals[LOG_NUMBER_SENT_ONCE]; // 一次最多取LOG_NUMBER_SENT_ONCE条日志
 
     while (true)
     {
@@ -220,46 +421,118 @@ CLogger::CLogger(uint16_t log_line_size)
     ,_auto_newline(true)
     ,_bin_log_enabled(false)
     ,_trace_log_enabled(false)
+    ,_microseconds_enabled(true)
+    ,_time_thread(NULL)
+    ,_binary_format(false)
+    ,_defined_format_number(0)
     ,_registered(false)
     ,_destroying(false)
     ,_screen_enabled(false)    
     ,_current_bytes(0)
     ,_log_queue(NULL)
+    ,_slot_size(LOG_SLOT_SIZE_DEFAULT)
+    ,_slot_number(0)
+    ,_slot_array(NULL)
+    ,_free_slots(NULL)
+    ,_free_slot_number(0)
+    ,_dropped_number(0)
+    ,_dropped_bytes(0)
+    ,_overload_policy(overload_drop_newest)
+    ,_overload_parameter(0)
+    ,_sample_counter(0)
     ,_waiter_number(0)
+    ,_drop_report_interval(60)
+    ,_last_report_time(0)
+    ,_has_unreported(false)
+    ,_sink(NULL)
+    ,_sink_retry_seconds(0)
+    ,_sink_retry_time(0)
 {    
+    _queue_lock.set_contention_name("logger.queue");
+    memset(_level_dropped_number, 0, sizeof(_level_dropped_number));
+    memset(_level_reported_number, 0, sizeof(_level_reported_number));
+    _destroy_message.length = 0;
+    _destroy_message.content[0] = '\0';
+
     atomic_set(&_max_bytes, DEFAULT_LOG_FILE_SIZE);
     atomic_set(&_log_level, LOG_LEVEL_INFO);
     atomic_set(&_backup_number, DEFAULT_LOG_FILE_BACKUP_NUMBER);
 
     // 保证日志行最大长度不小于指定值
     _log_line_size = (log_line_size < LOG_LINE_SIZE_MIN)? LOG_LINE_SIZE_MIN: log_line_size;
+    if (_log_line_size > LOG_LINE_SIZE_MAX)
+        _log_line_size = LOG_LINE_SIZE_MAX;
 }
 
 CLogger::~CLogger()
 {    
+    unpublish_log_level(this);
     //destroy(); 
     // 删除队列
     delete _log_queue;
     _log_queue = NULL;
 
+    // 删除日志槽
+    delete []_slot_array;
+    delete []_free_slots;
+    _slot_array = NULL;
+    _free_slots = NULL;
+
     if (_log_fd != -1)
     {
         close(_log_fd);
         _log_fd = -1;      
     }
+
+    delete _sink;
+    _sink = NULL;
+}
+
+void CLogger::set_sink(ILogSink* sink, uint32_t retry_seconds)
+{
+    _sink_retry_seconds = retry_seconds;
+    _sink = sink;
+}
+
+// 在日志线程中调用，返回成功发出的条数
+int CLogger::send_to_sink(const struct iovec* iov_array, int number)
+{
+    const time_t now = time(NULL);
+    if (now < _sink_retry_time)
+    {
+        get_sink_fallback_counter()->inc(number);
+        return 0;
+    }
+
+    int sent = _sink->send(iov_array, number);
+    if (sent < 0)
+        sent = 0;
+    if (sent < number)
+    {
+        _sink_retry_time = now + _sink_retry_seconds;
+        get_sink_fallback_counter()->inc(number - sent);
+    }
+
+    get_sink_sent_counter()->inc(sent);
+    return sent;
 }
 
 void CLogger::destroy()
 {       
+    // 报告还未报告的重复行
+    log_level_t repeated_level;
+    const uint32_t repeated_number = _repeat_filter.take_repeated(&repeated_level);
+    if ((repeated_number > 0) && !_binary_format)
+        log_repeated(repeated_level, repeated_number);
+
     { // _queue_lock
         LockHelper<CLock> lh(_queue_lock);
 
         // 停止Logger的日志，长度为0
-        log_message_t* log_message = (log_message_t*)malloc(sizeof(log_message_t));
-        log_message->length = 0;
-        log_message->content[0] = '\0';
         _destroying = true;
-        push_log_message(log_message);
+        push_log_message(&_destroy_message);
+        if (_waiter_number > 0)
+            _slot_event.broadcast();
     } // _queue_lock
 
     // 减引用计数，与create中的inc_refcount相呼应
@@ -278,17 +551,23 @@ void CLogger::destroy()
     } // CLogger::_thread_lock
 }
 
-void CLogger::create(const char* log_path, const char* log_filename, uint32_t log_queue_size)
+void CLogger::create(const char* log_path, const char* log_filename, uint32_t log_queue_size, uint16_t log_slot_size)
 {
     // 日志文件路径和文件名
     snprintf(_log_path, sizeof(_log_path), "%s", log_path);
     snprintf(_log_filename, sizeof(_log_filename), "%s", log_filename);    
 
-    // 创建日志队列
-    uint32_t log_queue_size_ = log_queue_size;
-    if (0 == log_queue_size_)
-        log_queue_size_ = 1;
-    _log_queue = new utils::CArrayQueue<log_message_t*>(log_queue_size_);
+    // 创建日志槽，所有槽都入队时还需要为销毁消息留一个位置
+    _slot_number = (0 == log_queue_size)? 1: log_queue_size;
+    if (log_slot_size > LOG_LINE_SIZE_MAX)
+        log_slot_size = LOG_LINE_SIZE_MAX;
+    _slot_size = (0 == log_slot_size)? LOG_SLOT_SIZE_DEFAULT: ((log_slot_size + 1) & ~1); // 保证槽头部的length对齐
+    _slot_array = new char[(sizeof(log_message_t) + _slot_size) * _slot_number];
+    _free_slots = new uint32_t[_slot_number];
+    for (uint32_t i=0; i<_slot_number; ++i)
+        _free_slots[i] = _slot_number - i - 1; // 先用低地址的槽
+    _free_slot_number = _slot_number;
+    _log_queue = new utils::CArrayQueue<log_message_t*>(_slot_number+1);
     
     // 创建和启动日志线程
     create_thread();
@@ -339,7 +618,8 @@ bool CLogger::execute()
 #if HAVE_UIO_H==1
             return batch_write();
 #else
-            return single_write();
+            // 有sink时总是成批取，以便成批发送，log_sink.h已包含sys/uio.h
+            return (NULL == _sink)? single_write(): batch_write();
 #endif // HAVE_UIO_H         
         }        
     }
@@ -375,9 +655,8 @@ bool CLogger::single_write()
     
     { // 限定锁的范围
         LockHelper<CLock> lh(_queue_lock);        
-        log_message = _log_queue->pop_front();
-        if (_waiter_number > 0)
-            _queue_event.signal();        
+        if (!_log_queue->is_empty())
+            log_message = _log_queue->pop_front();
     }
         
     // 分成两步，是避免write在Lock中
@@ -386,15 +665,20 @@ bool CLogger::single_write()
         // 读走信号
         read_signal(1);
         CLogger::_log_thread->dec_log_number(1);
+        get_backlog_gauge()->set(CLogger::_log_thread->get_log_number());
 
         // 需要销毁Logger了
         if (0 == log_message->length)
         {
-            free(log_message);
             return false;
         }
+        if (_binary_format)
+        {
+            write_bin_log_formats();
+        }
 
         // 循环处理中断
+        const uint64_t start_nanoseconds = CClock::get_nanoseconds();
         for (;;)
         {
             retval = write(_log_fd, log_message->content, log_message->length);
@@ -408,9 +692,16 @@ bool CLogger::single_write()
             
             break;
         }               
+        get_write_histogram()->record(CClock::get_nanoseconds() - start_nanoseconds);
+        get_lines_counter()->inc();
 
-        // 释放消息
-        free(log_message);                
+        // 归还日志槽
+        {
+            LockHelper<CLock> lh(_queue_lock);
+            reclaim_slot(log_message);
+            if (_waiter_number > 0)
+                _slot_event.broadcast();
+        }
 
         // 错误处理
         if (-1 == retval)
@@ -426,17 +717,17 @@ bool CLogger::batch_write()
 {
     bool to_destroy_logger = false;
 
-#if HAVE_UIO_H==1    
-    int retval;
+    int retval = 0;
     int number = 0;
-    struct iovec iov_array[LOG_NUMBER_WRITED_ONCE];
+    struct iovec iov_array[LOG_NUMBER_SENT_ONCE];
+    const int batch_number = (NULL == _sink)? LOG_NUMBER_WRITED_ONCE: LOG_NUMBER_SENT_ONCE;
     
     { // 空括号用来限定_queue_lock的范围
         LockHelper<CLock> lh(_queue_lock);
 
         // 批量取出消息
         int i = 0;
-        for (; i<LOG_NUMBER_WRITED_ONCE 
+        for (; i<batch_number 
             && i<IOV_MAX
             && !_log_queue->is_empty(); ++i)
         {
@@ -451,28 +742,32 @@ bool CLogger::batch_write()
             {
                 // 需要销毁Logger了
                 read_signal(1);
-                free(log_message);
                 to_destroy_logger = true;
                 CLogger::_log_thread->dec_log_number(1);
             }            
         }
-        if (_waiter_number > 0)
-        {
-            _queue_event.broadcast();
-        }
     }
   
     // 批量写入文件
     if (number > 0)
     {
+        // 在取出日志之后检查，保证被引用的格式都已注册
+        if (_binary_format)
+            write_bin_log_formats();
+
         // 读走信号
         read_signal(number);
         CLogger::_log_thread->dec_log_number(number);
+        get_backlog_gauge()->set(CLogger::_log_thread->get_log_number());
+
+        // 有sink时先发给sink，sink没发出的再写本地文件
+        const uint64_t start_nanoseconds = CClock::get_nanoseconds();
+        const int sent = (NULL == _sink)? 0: send_to_sink(iov_array, number);
 
         // 循环处理中断
-        for (;;)
+        for (; sent<number;)
         {
-            retval = writev(_log_fd, iov_array, number);
+            retval = writev(_log_fd, iov_array+sent, number-sent);
             if ((-1 == retval) && (EINTR == Error::code()))
             {
                 continue;
@@ -484,25 +779,31 @@ bool CLogger::batch_write()
             }
             
             break;
-        }                
+        }
+        get_write_histogram()->record(CClock::get_nanoseconds() - start_nanoseconds);
+        get_lines_counter()->inc(number);
 
-        // 释放消息
-        while (number-- > 0)
+        // 归还日志槽
         {
-            log_message_t* log_message;
-            void* iov_base = iov_array[number].iov_base;
+            LockHelper<CLock> lh(_queue_lock);
+            while (number-- > 0)
+            {
+                log_message_t* log_message;
+                void* iov_base = iov_array[number].iov_base;
 
-            log_message = get_struct_head_address(log_message_t, content, iov_base);
-            free(log_message);
+                log_message = get_struct_head_address(log_message_t, content, iov_base);
+                reclaim_slot(log_message);
+            }
+            if (_waiter_number > 0)
+                _slot_event.broadcast();
         }
 
         // 错误处理
         if (-1 == retval)
         {
-            throw CSyscallException(Error::code(), __FILE__, __LINE__, "logger writev");
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "writev");
         }
     }   
-#endif // HAVE_UIO_H
 
     return !to_destroy_logger;
 }
@@ -527,6 +828,11 @@ void CLogger::enable_auto_adddot(bool enabled)
     _auto_adddot = enabled;
 }
 
+void CLogger::enable_repeat_filter(bool enabled)
+{
+    _repeat_filter.enable(enabled);
+}
+
 void CLogger::enable_auto_newline(bool enabled)
 { 
     _auto_newline = enabled;
@@ -535,6 +841,12 @@ void CLogger::enable_auto_newline(bool enabled)
 void CLogger::set_log_level(log_level_t log_level)
 {
     atomic_set(&_log_level, log_level);
+    publish_log_level(this);
+}
+
+int CLogger::get_log_level() const
+{
+    return atomic_read(&_log_level);
 }
 
 void CLogger::set_single_filesize(uint32_t filesize)
@@ -597,104 +909,340 @@ bool CLogger::enabled_trace()
 
 void CLogger::do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
 {    
-    va_list args_copy;
-    va_copy(args_copy, args);
-    utils::VaListHelper vh(args_copy);
-    log_message_t* log_message = (log_message_t*)malloc(_log_line_size+sizeof(log_message_t)+1);
+    char* log_line = get_line_buffer();
+    int head_length;
 
-    char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
-    get_formatted_current_datetime(datetime, sizeof(datetime));
-    
-    // 模块名称
-    std::string module_name_field;
-    if (module_name != NULL)
+    if (_binary_format)
     {
-        module_name_field = std::string("[") + module_name + std::string("]");
+        // 时间、线程ID和级别在记录头中，内容只保留模块名、文件名和行号
+        char* content = log_line + sizeof(bin_log_header_t);
+        const uint16_t content_size = static_cast<uint16_t>(_log_line_size - sizeof(bin_log_header_t));
+        head_length = sizeof(bin_log_header_t) + ((NULL == module_name)?
+            utils::CStringUtils::fix_snprintf(content, content_size, "[%s:%d]", filename, lineno):
+            utils::CStringUtils::fix_snprintf(content, content_size, "[%s][%s:%d]", module_name, filename, lineno));
     }
-
-    // 在构造时，已经保证_log_line_size不会小于指定的值，所以下面的操作是安全的
-    int head_length = utils::CStringUtils::fix_snprintf(
-            log_message->content
-          , _log_line_size
-          , "[%s][0x%08x][%s]%s[%s:%d]"
-          , datetime
-          , CThread::get_current_thread_id()
-          , get_log_level_name(log_level)
-          , module_name_field.c_str()
-          , filename
-          , lineno);
-    int log_line_length = vsnprintf(log_message->content+head_length, _log_line_size-head_length, format, args);
-
-    if (log_line_length < _log_line_size-head_length)
+    else
     {
-        log_message->length = head_length + log_line_length;
+        char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
+        get_cached_formatted_datetime(datetime, sizeof(datetime), _microseconds_enabled, _time_thread);
+
+        // 在构造时，已经保证_log_line_size不会小于指定的值，所以下面的操作是安全的
+        head_length = (NULL == module_name)?
+            utils::CStringUtils::fix_snprintf(
+                log_line
+              , _log_line_size
+              , "[%s][0x%08x][%s][%s:%d]"
+              , datetime
+              , CThread::get_current_thread_id()
+              , get_log_level_name(log_level)
+              , filename
+              , lineno):
+            utils::CStringUtils::fix_snprintf(
+                log_line
+              , _log_line_size
+              , "[%s][0x%08x][%s][%s][%s:%d]"
+              , datetime
+              , CThread::get_current_thread_id()
+              , get_log_level_name(log_level)
+              , module_name
+              , filename
+              , lineno);
     }
-    else
+    --head_length; // fix_snprintf的返回值包含了结尾符
+
+    // 线程缓冲区总是按最大行长度分配，所以长的日志不需要再次格式化
+    int log_line_length = vsnprintf(log_line+head_length, LOG_LINE_SIZE_MAX-head_length, format, args);
+    if (log_line_length < 0)
+        log_line_length = 0;
+    else if (log_line_length >= LOG_LINE_SIZE_MAX-head_length)
+        log_line_length = LOG_LINE_SIZE_MAX-head_length-1; // 被截断
+    uint32_t length = static_cast<uint32_t>(head_length + log_line_length);
+
+    if (_repeat_filter.is_enabled() && !_binary_format)
     {
-        // 预定的缓冲区不够大，需要增大
-        int new_line_length = log_line_length + head_length;
-        if (new_line_length > LOG_LINE_SIZE_MAX)
-            new_line_length = LOG_LINE_SIZE_MAX;
-        
-        log_message_t* new_log_message = (log_message_t*)malloc(new_line_length+sizeof(log_message_t)+1);
-        if (NULL == new_log_message)
-        {
-            // 重新分配失败
-            log_message->length = head_length + (log_line_length - 1);
-        }
-        else
-        {
-            free(log_message); // 释放老的，指向新的
-            log_message = new_log_message;
-                                    
-            // 这里不需要关心返回值了
-            head_length  = utils::CStringUtils::fix_snprintf(log_message->content, new_line_length, "[%s][0x%08x][%s]", datetime, CThread::get_current_thread_id(), get_log_level_name(log_level));
-            log_line_length = utils::CStringUtils::fix_vsnprintf(log_message->content+head_length, new_line_length-head_length, format, args_copy);            
-            log_message->length = head_length + log_line_length;
-        }
+        uint32_t repeated_number = 0;
+        log_level_t repeated_level;
+        if (_repeat_filter.filter(log_level, filename, lineno, log_line+head_length, log_line_length, &repeated_number, &repeated_level))
+            return;
+        if (repeated_number > 0)
+            log_repeated(repeated_level, repeated_number);
     }
-    
+
     // 自动添加结尾点号
     if (_auto_adddot 
-     && (log_message->content[log_message->length-1] != '.')
-     && (log_message->content[log_message->length-1] != '\n'))
+     && (log_line[length-1] != '.')
+     && (log_line[length-1] != '\n'))
     {
-        log_message->content[log_message->length] = '.';
-        log_message->content[log_message->length+1] = '\0';
-        ++log_message->length;
+        log_line[length++] = '.';
     }
 
     // 自动添加换行符
-    if (_auto_newline && (log_message->content[log_message->length-1] != '\n'))
+    if (_auto_newline && (log_line[length-1] != '\n'))
     {
-        log_message->content[log_message->length] = '\n';
-        log_message->content[log_message->length+1] = '\0';
-        ++log_message->length;
+        log_line[length++] = '\n';
     }
 
-    // 允许打屏
-    if (_screen_enabled)
+    if (_binary_format)
     {
-        (void)write(STDOUT_FILENO, log_message->content, log_message->length);
+        fill_bin_log_header(reinterpret_cast<bin_log_header_t*>(log_line), BIN_LOG_RECORD_LOG, log_level, BIN_LOG_TEXT_FORMAT_ID, length);
     }
-    
+    else if (_screen_enabled)
+    {
+        // 允许打屏
+        (void)write(STDOUT_FILENO, log_line, length);
+    }
+
+    queue_log_line(log_level, log_line, length);
+}
+
+void CLogger::queue_log_line(log_level_t log_level, const char* log_line, uint32_t log_line_length)
+{
     // 日志消息放入队列中
     LockHelper<CLock> lh(_queue_lock);
     if (!_destroying)
     {
+        if (push_log_line(log_level, log_line, log_line_length) && _has_unreported && (_drop_report_interval > 0))
+            report_dropped();
+    }
+}
+
+// 重复行的汇总，没有代码位置，不再经过重复过滤
+void CLogger::log_repeated(log_level_t log_level, uint32_t repeated_number)
+{
+    char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
+    char log_line[LOG_LINE_SIZE_MIN];
+
+    get_cached_formatted_datetime(datetime, sizeof(datetime), _microseconds_enabled, _time_thread);
+    const int length = utils::CStringUtils::fix_snprintf(
+        log_line, sizeof(log_line), "[%s][0x%08x][%s]last message repeated %u times\n",
+        datetime, CThread::get_current_thread_id(), get_log_level_name(log_level), repeated_number) - 1;
+    if (_screen_enabled)
+        (void)write(STDOUT_FILENO, log_line, length);
+    queue_log_line(log_level, log_line, static_cast<uint32_t>(length));
+}
+
+void CLogger::log_struct(uint32_t format_id, ...)
+{
+    va_list args;
+    va_start(args, format_id);
+    utils::VaListHelper vh(args);
+
+    vlog_struct(format_id, args);
+}
+
+void CLogger::vlog_struct(uint32_t format_id, va_list& args)
+{
+    const bin_log_format_t* bin_log_format = get_bin_log_format(format_id);
+    if (NULL == bin_log_format)
+        return;
+
+    const log_level_t log_level = bin_log_format->log_level;
+    if ((LOG_LEVEL_TRACE == log_level)? !_trace_log_enabled: (atomic_read(&_log_level) > log_level))
+        return;
+
+    // 文本格式或者格式串含有不支持的转换时，在这里格式化
+    if (!_binary_format || !bin_log_format->supported)
+    {
+        do_log(log_level, bin_log_format->filename.c_str(), bin_log_format->lineno, NULL, bin_log_format->format.c_str(), args);
+        return;
+    }
+
+    char* log_line = get_line_buffer();
+    const uint32_t length = encode_bin_log(log_line, _log_line_size, format_id, *bin_log_format, args);
+    queue_log_line(log_level, log_line, length);
+}
+
+// 只在日志线程中调用，将新注册的格式定义写入当前日志文件
+void CLogger::write_bin_log_formats()
+{
+    const uint32_t format_number = get_bin_log_format_number();
+    if (_defined_format_number >= format_number)
+        return;
+
+    std::string records;
+    for (uint32_t format_id=_defined_format_number; format_id<format_number; ++format_id)
+    {
+        const bin_log_format_t* bin_log_format = get_bin_log_format(format_id);
+        if (bin_log_format != NULL)
+            encode_bin_log_format(&records, format_id, *bin_log_format);
+    }
+
+    const char* data = records.data();
+    size_t remaining = records.size();
+    while (remaining > 0)
+    {
+        const ssize_t retval = write(_log_fd, data, remaining);
+        if (-1 == retval)
+        {
+            if (EINTR == Error::code())
+                continue;
+
+            // 不抛异常，以免已取出的日志槽不能归还，下次再重写
+            fprintf(stderr, "Writed log formats %s/%s error: %s.\n", _log_path, _log_filename, Error::to_string().c_str());
+            return;
+        }
+
+        data += retval;
+        remaining -= retval;
+        _current_bytes += static_cast<uint32_t>(retval);
+    }
+
+    _defined_format_number = format_number;
+}
+
+void CLogger::set_overload_policy(overload_policy_t overload_policy, uint32_t parameter)
+{
+    LockHelper<CLock> lh(_queue_lock);
+    _overload_policy = overload_policy;
+    _overload_parameter = parameter;
+    _sample_counter = 0;
+
+    // 从阻塞改为其它策略时，唤醒正在等待的线程
+    if (_waiter_number > 0)
+        _slot_event.broadcast();
+}
+
+uint64_t CLogger::get_dropped_number(log_level_t log_level) const
+{
+    if ((log_level < LOG_LEVEL_DETAIL) || (log_level > LOG_LEVEL_BIN))
+        return 0;
+    return __atomic_load_n(&_level_dropped_number[log_level], __ATOMIC_RELAXED);
+}
+
+// 调用者需持有_queue_lock，返回true表示需要丢弃
+bool CLogger::need_drop(log_level_t log_level, uint32_t slot_number)
+{
+    // 比全部槽还大的，怎么也放不下
+    if (slot_number > _slot_number)
+        return true;
+
+    if (overload_block == _overload_policy)
+    {
+        while ((slot_number > _free_slot_number) && !_destroying && (overload_block == _overload_policy))
+        {
+            ++_waiter_number;
+            _slot_event.wait(_queue_lock);
+            --_waiter_number;
+        }
+
+        return (slot_number > _free_slot_number) || _destroying;
+    }
+
+    if (slot_number > _free_slot_number)
+        return true;
+
+    // 空闲槽少于1/4时视为过载
+    if (_free_slot_number - slot_number >= _slot_number / 4)
+        return false;
+    if (overload_drop_level == _overload_policy)
+        return static_cast<uint32_t>(log_level) < _overload_parameter;
+    if ((overload_sample == _overload_policy) && (_overload_parameter > 1))
+        return (_sample_counter++ % _overload_parameter) != 0;
+    return false;
+}
+
+// 调用者需持有_queue_lock
+bool CLogger::push_log_line(log_level_t log_level, const char* log_line, uint32_t log_line_length)
+{
+    const uint32_t slot_number = (log_line_length + _slot_size - 1) / _slot_size;
+    if (need_drop(log_level, slot_number))
+    {
+        // 丢弃而不阻塞
+        __atomic_add_fetch(&_dropped_number, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&_dropped_bytes, log_line_length, __ATOMIC_RELAXED);
+        get_dropped_counter()->inc();
+        if ((log_level >= LOG_LEVEL_DETAIL) && (log_level <= LOG_LEVEL_BIN))
+            __atomic_add_fetch(&_level_dropped_number[log_level], 1, __ATOMIC_RELAXED);
+        _has_unreported = true;
+        return false;
+    }
+
+    // 同一行日志的多个槽在同一把锁内连续入队，所以不会和其它日志交错
+    for (uint32_t offset=0; offset<log_line_length; offset+=_slot_size)
+    {
+        const uint32_t index = _free_slots[--_free_slot_number];
+        log_message_t* log_message = reinterpret_cast<log_message_t*>(_slot_array + (sizeof(log_message_t) + _slot_size) * index);
+        const uint32_t length = (log_line_length - offset < _slot_size)? log_line_length - offset: _slot_size;
+
+        memcpy(log_message->content, log_line + offset, length);
+        log_message->length = static_cast<uint16_t>(length);
         push_log_message(log_message);
     }
+
+    get_mem_tracker()->allocate((sizeof(log_message_t) + _slot_size) * slot_number);
+
+    return true;
 }
 
-void CLogger::push_log_message(log_message_t* log_message)
-{    
-    while (_log_queue->is_full())
+// 调用者需持有_queue_lock，仅在有未报告的丢弃时才被调用，所以平时不会取时间
+void CLogger::report_dropped()
+{
+    const time_t now = time(NULL);
+    if (now - _last_report_time < static_cast<time_t>(_drop_report_interval))
+        return;
+
+    char report[LOG_LINE_SIZE_MIN*2];
+    int length;
+
+    if (_binary_format)
     {
-        ++_waiter_number;
-        _queue_event.wait(_queue_lock);
-        --_waiter_number;
+        // 头部在最后填写
+        length = sizeof(bin_log_header_t);
+        length += snprintf(report+length, sizeof(report)-length, "dropped by overload:");
     }
+    else
+    {
+        char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
+        get_cached_formatted_datetime(datetime, sizeof(datetime), _microseconds_enabled, _time_thread);
+        length = snprintf(report, sizeof(report), "[%s][0x%08x][%s]dropped by overload:"
+            , datetime, CThread::get_current_thread_id(), get_log_level_name(LOG_LEVEL_STATE));
+    }
+    for (int i=LOG_LEVEL_DETAIL; (i<=LOG_LEVEL_BIN) && (length<static_cast<int>(sizeof(report))); ++i)
+    {
+        const uint64_t dropped_number = _level_dropped_number[i] - _level_reported_number[i];
+        if (dropped_number > 0)
+        {
+            length += snprintf(report+length, sizeof(report)-length, " %s=%" PRIu64, get_log_level_name(static_cast<log_level_t>(i)), dropped_number);
+            _level_reported_number[i] = _level_dropped_number[i];
+        }
+    }
+    // 截断时以换行符覆盖最后一个字符
+    if (length > static_cast<int>(sizeof(report)) - 2)
+        length = static_cast<int>(sizeof(report)) - 2;
+    report[length++] = '\n';
+    if (_binary_format)
+    {
+        bin_log_header_t header; // report未必按头部对齐
+        fill_bin_log_header(&header, BIN_LOG_RECORD_LOG, LOG_LEVEL_STATE, BIN_LOG_TEXT_FORMAT_ID, static_cast<uint32_t>(length));
+        memcpy(report, &header, sizeof(header));
+    }
+
+    _last_report_time = now;
+    _has_unreported = false;
+
+    // 报告本身也可能因为没有空闲槽而被丢弃，那样下个间隔会再报告
+    const uint32_t slot_number = (length + _slot_size - 1) / _slot_size;
+    if (slot_number <= _free_slot_number)
+    {
+        (void)push_log_line(LOG_LEVEL_STATE, report, static_cast<uint32_t>(length));
+    }
+    else
+    {
+        _has_unreported = true;
+    }
+}
 
+// 调用者需持有_queue_lock
+void CLogger::reclaim_slot(log_message_t* log_message)
+{
+    const uint32_t index = static_cast<uint32_t>((reinterpret_cast<char*>(log_message) - _slot_array) / (sizeof(log_message_t) + _slot_size));
+    _free_slots[_free_slot_number++] = index;
+    get_mem_tracker()->release(sizeof(log_message_t) + _slot_size);
+}
+
+void CLogger::push_log_message(log_message_t* log_message)
+{    
+    // 队列的容量比槽的个数多1，所以总是不会满
     CLogger::_log_thread->inc_log_number();
     _log_queue->push_back(log_message);    
     send_signal();
@@ -839,6 +1387,7 @@ void CLogger::create_logfile(bool truncate)
     }       
            
     _current_bytes = st.st_size;
+    _defined_format_number = 0; // 新文件需要重新写入格式定义
     CLogger::_log_thread->register_logger(this);    
 }
 
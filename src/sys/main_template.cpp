@@ -16,14 +16,23 @@
  *
  * Author: jian yi, eyjian@qq.com
  */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <strings.h>
 #include <stdexcept>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <utils/string_utils.h>
+#include "net/metrics_exporter.h"
+#include "sys/clock.h"
+#include "sys/datetime_utils.h"
+#include "sys/flight_recorder.h"
+#include "sys/profiler.h"
 #include "sys/safe_logger.h"
 #include "sys/signal_handler.h"
 #include "sys/utils.h"
@@ -58,6 +67,52 @@ static bool parent_process(IMainHelper* main_helper, pid_t child_pid, int& child
 // 是否收到了退出信号
 int exit_by_signal = 0;
 
+// 按命令行参数metrics_port和metrics_push启动的度量导出器
+static net::CMetricsExporter* sg_metrics_exporter = NULL;
+
+static void start_metrics_exporter(IMainHelper* main_helper)
+{
+    const uint16_t port = argument::metrics_port->value();
+    const std::string& push = argument::metrics_push->value();
+    if ((0 == port) && push.empty())
+        return;
+
+    sg_metrics_exporter = new net::CMetricsExporter;
+    try
+    {
+        if (port > 0)
+            sg_metrics_exporter->enable_http(argument::metrics_ip->value(), port);
+        if (!push.empty())
+        {
+            const std::string::size_type colon = push.rfind(':');
+            if (std::string::npos == colon)
+                THROW_EXCEPTION(utils::CStringUtils::format_string("invalid metrics_push: %s", push.c_str()), EINVAL);
+
+            const uint16_t push_port = static_cast<uint16_t>(atoi(push.c_str()+colon+1));
+            sg_metrics_exporter->enable_push(push.substr(0, colon), push_port, argument::metrics_push_interval->value());
+        }
+        if (argument::metrics_sample_interval->value() > 0)
+            sg_metrics_exporter->enable_sampling(argument::metrics_sample_interval->value());
+
+        sg_metrics_exporter->start();
+        __MYLOG_INFO(main_helper->get_logger(), NULL, "Metrics exporter started, port: %u, push: %s.\n",
+                     sg_metrics_exporter->get_http_port(), push.c_str());
+    }
+    catch (utils::CException& ex)
+    {
+        // 导出度量不是必须的，出错时进程继续运行
+        __MYLOG_ERROR(main_helper->get_logger(), NULL, "Start metrics exporter failed: %s.\n", ex.str().c_str());
+        delete sg_metrics_exporter;
+        sg_metrics_exporter = NULL;
+    }
+}
+
+static void stop_metrics_exporter()
+{
+    delete sg_metrics_exporter;
+    sg_metrics_exporter = NULL;
+}
+
 // 信号线程
 static sigset_t sg_sigset;
 static pthread_t sg_signal_thread;
@@ -202,12 +257,17 @@ void child_process(IMainHelper* main_helper, int argc, char* argv[], IReportSelf
     }
 
     // 启动上报
+    const uint64_t report_milliseconds = CClock::get_milliseconds();
     report_self->start_report_self();
+    start_metrics_exporter(main_helper);
+    __MYLOG_INFO(main_helper->get_logger(), NULL, "Started report self and metrics exporter in %" PRIu64"ms.\n",
+                 CClock::get_milliseconds() - report_milliseconds);
 
     // 正式运行
     if (!main_helper->run())
 	{
 		//fprintf(stderr, "Main helper run failed.\n");
+        stop_metrics_exporter();
         report_self->stop_report_self();
 		main_helper->fini();
 		exit(1);
@@ -229,6 +289,7 @@ void child_process(IMainHelper* main_helper, int argc, char* argv[], IReportSelf
         }
     }
 
+    stop_metrics_exporter();
     report_self->stop_report_self();
     main_helper->fini();
     exit(errcode);
@@ -295,11 +356,84 @@ bool parent_process(IMainHelper* main_helper, pid_t child_pid, int& child_exit_c
     return restart;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// 平滑重启时新旧进程间传递fd，使用SOCK_SEQPACKET以保持消息边界，
+// 每条消息的数据为以'\0'结尾的name，附带一个SCM_RIGHTS的fd，name为空的消息表示结束，
+// 名为HANDOVER_SNAPSHOT的为快照的memfd，在各监听fd之前发送
+#define HANDOVER_ENV_NAME "MOOON_HANDOVER_FD"
+#define HANDOVER_READY "ready"
+#define HANDOVER_SNAPSHOT "mooon.snapshot"
+
+static bool send_handover_fd(int sock, const std::string& name, int fd)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov;
+    struct msghdr msg;
+
+    memset(control, 0, sizeof(control));
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = const_cast<char*>(name.c_str());
+    iov.iov_len = name.size() + 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd != -1)
+    {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    while (true)
+    {
+        if (sendmsg(sock, &msg, MSG_NOSIGNAL) != -1)
+            return true;
+        if (errno != EINTR)
+            return false;
+    }
+}
+
+static bool receive_handover_fd(int sock, std::string* name, int* fd)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    char buffer[256];
+    struct iovec iov;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t bytes;
+    while ((-1 == (bytes = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC))) && (EINTR == errno));
+    if ((bytes <= 0) || (buffer[bytes-1] != '\0'))
+        return false;
+
+    *fd = -1;
+    for (struct cmsghdr* cmsg=CMSG_FIRSTHDR(&msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msg, cmsg))
+    {
+        if ((SOL_SOCKET == cmsg->cmsg_level) && (SCM_RIGHTS == cmsg->cmsg_type))
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    name->assign(buffer);
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // CMainHelper
 
-CMainHelper::CMainHelper(int log_level_signo)
-    : _log_level_signo(log_level_signo),
+CMainHelper::CMainHelper(int log_level_signo, int profile_signo, int reload_signo, int upgrade_signo, int flight_signo)
+    : _log_level_signo(log_level_signo), _profile_signo(profile_signo),
+      _reload_signo(reload_signo), _upgrade_signo(upgrade_signo), _flight_signo(flight_signo), _handover_fd(-1),
+      _initialized(false), _handed_over(false),
       _logline_size(mooon::SIZE_4K),
       _stop(false),
       _signal_thread(NULL)
@@ -322,10 +456,13 @@ void CMainHelper::signal_thread()
 
 bool CMainHelper::init(int argc, char* argv[])
 {
+    _argv.assign(argv, argv+argc);
+
     do
     {
         // 命令行参数解析
         std::string errmsg;
+        uint64_t phase_milliseconds = CClock::get_milliseconds();
         if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
         {
             if (!errmsg.empty())
@@ -333,6 +470,7 @@ bool CMainHelper::init(int argc, char* argv[])
             fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
             break;
         }
+        add_startup_phase("parse_arguments", &phase_milliseconds);
         // 参数检查
         if (!on_check_parameter())
         {
@@ -340,6 +478,7 @@ bool CMainHelper::init(int argc, char* argv[])
             fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
             break;
         }
+        add_startup_phase("check_parameter", &phase_milliseconds);
 
         // 创建日志器
         try
@@ -348,12 +487,14 @@ bool CMainHelper::init(int argc, char* argv[])
                 mooon::sys::g_logger = mooon::sys::create_safe_logger(true, _logline_size, _log_suffix);
             else
                 mooon::sys::g_logger = mooon::sys::create_safe_logger(_log_name, _logline_size, true);
+            mooon::sys::publish_log_level(mooon::sys::g_logger);
         }
         catch (mooon::sys::CSyscallException& ex)
         {
             fprintf(stderr, "Create logger failed: %s\n", ex.str().c_str());
             break;
         }
+        add_startup_phase("create_logger", &phase_milliseconds);
         try
         {
             // 通过SIGTERM幽雅退出
@@ -363,25 +504,61 @@ bool CMainHelper::init(int argc, char* argv[])
             {
                 mooon::sys::CSignalHandler::block_signal(_log_level_signo);
             }
+            // 启停采样分析信号
+            if (_profile_signo > 0)
+            {
+                mooon::sys::CSignalHandler::block_signal(_profile_signo);
+            }
+            // 重新加载和平滑重启信号
+            if (_reload_signo > 0)
+            {
+                mooon::sys::CSignalHandler::block_signal(_reload_signo);
+            }
+            if (_upgrade_signo > 0)
+            {
+                mooon::sys::CSignalHandler::block_signal(_upgrade_signo);
+            }
+            // 飞行记录器和转储信号
+            init_flight_recorder();
+            if ((_flight_signo > 0) && (get_flight_events_per_thread() > 0))
+            {
+                mooon::sys::CSignalHandler::block_signal(_flight_signo);
+            }
 
             on_block_signal(); // 让子类有机会阻塞其它信号
-            _signal_thread = new mooon::sys::CThreadEngine( // 创建信号线程
-                    mooon::sys::bind(
-                            &CMainHelper::signal_thread, this));
+            if (use_signal_thread())
+            {
+                _signal_thread = new mooon::sys::CThreadEngine( // 创建信号线程
+                        mooon::sys::bind(
+                                &CMainHelper::signal_thread, this));
+            }
+            add_startup_phase("block_signal", &phase_milliseconds);
+            receive_inherited_fds(); // 平滑重启启动的，取得旧进程交来的fd和快照
+            if (!_snapshot_manager.has_snapshot() && !get_snapshot_filepath().empty())
+                (void)_snapshot_manager.adopt_file(get_snapshot_filepath());
+            add_startup_phase("handover", &phase_milliseconds);
             if (!on_init(argc, argv)) // 执行初始化
             {
+                finish_handover(false);
+                MYLOG_ERROR("Initialized failed, %s\n", _startup_profiler.to_string().c_str());
                 break;
             }
+            add_startup_phase("on_init", &phase_milliseconds);
+            finish_handover(true);
+            _initialized = true;
+            MYLOG_INFO("Initialized, %s\n", _startup_profiler.to_string().c_str());
             return true;
         }
         catch (mooon::sys::CSyscallException& ex)
         {
             MYLOG_ERROR("%s\n", ex.str().c_str());
+            finish_handover(false);
             break;
         }
         catch (mooon::utils::CException& ex)
         {
             MYLOG_ERROR("%s\n", ex.str().c_str());
+            finish_handover(false);
             break;
         }
     }
@@ -403,6 +580,20 @@ void CMainHelper::fini()
         _signal_thread = NULL;
     }
 
+    // 在on_fini之前保存，这时登记的组件都还可用
+    const std::string snapshot_filepath = get_snapshot_filepath();
+    if (_initialized && _stop && !_handed_over && !snapshot_filepath.empty() && (_snapshot_manager.get_component_number() > 0))
+    {
+        try
+        {
+            _snapshot_manager.save_to_file(snapshot_filepath);
+            MYLOG_INFO("Saved snapshot of %u components to %s\n", _snapshot_manager.get_component_number(), snapshot_filepath.c_str());
+        }
+        catch (CSyscallException& ex)
+        {
+            MYLOG_ERROR("Save snapshot failed: %s\n", ex.str().c_str());
+        }
+    }
     on_fini();
     if (_stop)
     {
@@ -410,6 +601,11 @@ void CMainHelper::fini()
     }
 }
 
+void CMainHelper::dispatch_signal(int signo)
+{
+    mooon::sys::CSignalHandler::dispatch(this, signo);
+}
+
 void CMainHelper::on_terminated()
 {
     // 优雅退出
@@ -428,7 +624,23 @@ void CMainHelper::on_exception(int errcode)
 
 void CMainHelper::on_signal_handler(int signo)
 {
-    if (_log_level_signo == signo)
+    if ((_profile_signo > 0) && (_profile_signo == signo))
+    {
+        toggle_profiler();
+    }
+    else if ((_reload_signo > 0) && (_reload_signo == signo))
+    {
+        (void)reload();
+    }
+    else if ((_upgrade_signo > 0) && (_upgrade_signo == signo))
+    {
+        (void)graceful_restart();
+    }
+    else if ((_flight_signo > 0) && (_flight_signo == signo))
+    {
+        dump_flight_recorder();
+    }
+    else if (_log_level_signo == signo)
     {
         if (g_logger != NULL)
         {
@@ -446,6 +658,284 @@ void CMainHelper::on_signal_handler(int signo)
     }
 }
 
+void CMainHelper::toggle_profiler()
+{
+    try
+    {
+        if (!CProfiler::is_running())
+        {
+            CTracer::clear();
+            CTracer::enable(true);
+            CLockProfiler::clear();
+            CLockProfiler::enable(true);
+            CProfiler::start();
+            MYLOG_INFO("Profiler started\n");
+        }
+        else
+        {
+            CProfiler::stop();
+            CTracer::enable(false);
+            CLockProfiler::enable(false);
+
+            const std::string prefix = utils::CStringUtils::format_string("%s/%s.%d.%s",
+                get_log_dirpath().c_str(), CUtils::get_program_short_name().c_str(), getpid(),
+                CDatetimeUtils::get_current_datetime("%04d%02d%02d%02d%02d%02d").c_str());
+            CProfiler::write_collapsed(prefix + ".collapsed");
+            CTracer::write_chrome_trace(prefix + ".trace.json");
+            CLockProfiler::write(prefix + ".locks");
+            MYLOG_INFO("Profiler stopped with %" PRIu64" samples (%" PRIu64" dropped): %s.collapsed\n",
+                       CProfiler::get_sample_number(), CProfiler::get_dropped_number(), prefix.c_str());
+        }
+    }
+    catch (CSyscallException& ex)
+    {
+        CTracer::enable(false);
+        CLockProfiler::enable(false);
+        MYLOG_ERROR("Toggle profiler failed: %s\n", ex.str().c_str());
+    }
+}
+
+void CMainHelper::init_flight_recorder()
+{
+    const uint32_t events_per_thread = get_flight_events_per_thread();
+    if (0 == events_per_thread)
+        return;
+
+    // 信号处理函数中不能格式化文件名，事先设置好
+    CFlightRecorder::enable(true, events_per_thread);
+    CFlightRecorder::set_crash_filename(utils::CStringUtils::format_string("%s/%s.%d.crash.flight",
+        get_log_dirpath().c_str(), CUtils::get_program_short_name().c_str(), getpid()));
+    if (!CSignalHandler::handle_fatal_signals(CFlightRecorder::dump_on_signal))
+        MYLOG_WARN("Handle fatal signals failed: %s\n", CUtils::get_last_error_message().c_str());
+}
+
+void CMainHelper::dump_flight_recorder()
+{
+    if (!CFlightRecorder::is_enabled())
+        return;
+
+    const std::string filename = utils::CStringUtils::format_string("%s/%s.%d.%s.flight",
+        get_log_dirpath().c_str(), CUtils::get_program_short_name().c_str(), getpid(),
+        CDatetimeUtils::get_current_datetime("%04d%02d%02d%02d%02d%02d").c_str());
+    try
+    {
+        CFlightRecorder::dump(filename);
+        MYLOG_INFO("Flight recorder dumped: %s\n", filename.c_str());
+    }
+    catch (CSyscallException& ex)
+    {
+        MYLOG_ERROR("Dump flight recorder failed: %s\n", ex.str().c_str());
+    }
+}
+
+bool CMainHelper::reload()
+{
+    LockHelper<CLock> lock_helper(_reload_lock);
+    const uint64_t start = CClock::get_milliseconds();
+    bool reloaded = false;
+
+    try
+    {
+        reloaded = on_reload();
+    }
+    catch (CSyscallException& ex)
+    {
+        MYLOG_ERROR("Reload exception: %s\n", ex.str().c_str());
+    }
+    catch (utils::CException& ex)
+    {
+        MYLOG_ERROR("Reload exception: %s\n", ex.str().c_str());
+    }
+
+    if (reloaded)
+        MYLOG_INFO("Reloaded in %" PRIu64"ms\n", CClock::get_milliseconds() - start);
+    else
+        MYLOG_ERROR("Reload failed, keep running with the old configuration\n");
+    return reloaded;
+}
+
+bool CMainHelper::graceful_restart()
+{
+    if (_argv.empty())
+        return false;
+
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, fds))
+    {
+        MYLOG_ERROR("Graceful restart failed: socketpair: %s\n", Error::to_string().c_str());
+        return false;
+    }
+
+    // fork前准备好exec的参数和环境变量，子进程中只调用异步信号安全的函数
+    std::vector<char*> argv;
+    for (std::vector<std::string>::size_type i=0; i<_argv.size(); ++i)
+        argv.push_back(const_cast<char*>(_argv[i].c_str()));
+    argv.push_back(NULL);
+
+    const std::string handover_env = utils::CStringUtils::format_string("%s=%d", HANDOVER_ENV_NAME, fds[1]);
+    std::vector<char*> envp;
+    for (char** env=environ; *env!=NULL; ++env)
+    {
+        if (strncmp(*env, HANDOVER_ENV_NAME"=", sizeof(HANDOVER_ENV_NAME)) != 0)
+            envp.push_back(*env);
+    }
+    envp.push_back(const_cast<char*>(handover_env.c_str()));
+    envp.push_back(NULL);
+
+    const pid_t pid = fork();
+    if (-1 == pid)
+    {
+        MYLOG_ERROR("Graceful restart failed: fork: %s\n", Error::to_string().c_str());
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (0 == pid)
+    {
+        // 信号掩码会被exec继承，新进程应从不阻塞任何信号开始
+        sigset_t sigset;
+        sigemptyset(&sigset);
+        pthread_sigmask(SIG_SETMASK, &sigset, NULL);
+        if (-1 == fcntl(fds[1], F_SETFD, 0))
+            _exit(1);
+        execve("/proc/self/exe", &argv[0], &envp[0]);
+        _exit(127);
+    }
+
+    const int sock = fds[0];
+    bool ready = true;
+    close(fds[1]);
+    if (_snapshot_manager.get_component_number() > 0)
+    {
+        // 快照不是必须的，保存失败时新进程冷启动
+        try
+        {
+            const int snapshot_fd = _snapshot_manager.save_to_memfd();
+            ready = send_handover_fd(sock, HANDOVER_SNAPSHOT, snapshot_fd);
+            close(snapshot_fd);
+        }
+        catch (CSyscallException& ex)
+        {
+            MYLOG_ERROR("Save snapshot failed: %s\n", ex.str().c_str());
+        }
+    }
+    for (std::map<std::string, int>::const_iterator iter=_listen_fds.begin(); ready&&iter!=_listen_fds.end(); ++iter)
+        ready = send_handover_fd(sock, iter->first, iter->second);
+    ready = ready && send_handover_fd(sock, std::string(""), -1);
+    if (ready)
+    {
+        // 新进程初始化成功后发来ready，失败退出时为EOF
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        int n;
+        while ((-1 == (n = poll(&pfd, 1, static_cast<int>(get_handover_milliseconds())))) && (EINTR == errno));
+
+        std::string name;
+        int fd = -1;
+        ready = (n > 0) && receive_handover_fd(sock, &name, &fd) && (HANDOVER_READY == name);
+        if (fd != -1)
+            close(fd);
+    }
+    close(sock);
+
+    if (!ready)
+    {
+        MYLOG_ERROR("Graceful restart failed, new process %d is not ready and killed\n", pid);
+        kill(pid, SIGKILL);
+        while ((-1 == waitpid(pid, NULL, 0)) && (EINTR == errno));
+        return false;
+    }
+
+    // 新进程已在同一监听fd上accept，旧进程排空后退出
+    _handed_over = true;
+    MYLOG_INFO("New process %d is ready with %zu fds, draining\n", pid, _listen_fds.size());
+    on_drain();
+    const uint64_t deadline = CClock::get_milliseconds() + get_drain_milliseconds();
+    while (!is_drained() && (CClock::get_milliseconds() < deadline))
+        CUtils::millisleep(100);
+    MYLOG_INFO("Drained%s, exit for graceful restart\n", is_drained()? "": " timeout");
+    on_terminated();
+    return true;
+}
+
+void CMainHelper::register_listen_fd(const std::string& name, int fd)
+{
+    _listen_fds[name] = fd;
+}
+
+void CMainHelper::add_startup_phase(const char* name, uint64_t* start_milliseconds)
+{
+    const uint64_t end_milliseconds = CClock::get_milliseconds();
+    _startup_profiler.add_phase(name, *start_milliseconds, end_milliseconds);
+    *start_milliseconds = end_milliseconds;
+}
+
+bool CMainHelper::register_snapshot(const std::string& name, ISnapshotable* component, uint32_t version)
+{
+    return _snapshot_manager.register_component(name, component, version);
+}
+
+int CMainHelper::get_inherited_fd(const std::string& name)
+{
+    std::map<std::string, int>::iterator iter = _inherited_fds.find(name);
+    if (iter == _inherited_fds.end())
+        return -1;
+
+    const int fd = iter->second;
+    _inherited_fds.erase(iter);
+    return fd;
+}
+
+void CMainHelper::receive_inherited_fds()
+{
+    const char* handover_env = getenv(HANDOVER_ENV_NAME);
+    if (NULL == handover_env)
+        return;
+
+    _handover_fd = atoi(handover_env);
+    (void)unsetenv(HANDOVER_ENV_NAME);
+    (void)fcntl(_handover_fd, F_SETFD, FD_CLOEXEC);
+    while (true)
+    {
+        std::string name;
+        int fd;
+        if (!receive_handover_fd(_handover_fd, &name, &fd))
+        {
+            MYLOG_ERROR("Receive fds from old process failed: %s\n", Error::to_string().c_str());
+            break;
+        }
+        if (name.empty())
+            break;
+        if (-1 == fd)
+            continue;
+        if (HANDOVER_SNAPSHOT == name)
+            (void)_snapshot_manager.adopt(fd);
+        else
+            _inherited_fds[name] = fd;
+    }
+    MYLOG_INFO("Inherited %zu fds from old process\n", _inherited_fds.size());
+}
+
+void CMainHelper::finish_handover(bool ready)
+{
+    if (_handover_fd != -1)
+    {
+        // 失败时直接关闭，旧进程收到EOF后继续服务
+        if (ready)
+            (void)send_handover_fd(_handover_fd, HANDOVER_READY, -1);
+        close(_handover_fd);
+        _handover_fd = -1;
+    }
+    for (std::map<std::string, int>::iterator iter=_inherited_fds.begin(); iter!=_inherited_fds.end(); ++iter)
+    {
+        MYLOG_WARN("Inherited fd %d(%s) is not used and closed\n", iter->second, iter->first.c_str());
+        close(iter->second);
+    }
+    _inherited_fds.clear();
+
+    // 未被register_snapshot认领的快照数据不再需要
+    (void)_snapshot_manager.release();
+}
+
 void CMainHelper::set_logger(const std::string& log_suffix, uint16_t logline_size)
 {
     _log_suffix = log_suffix;
@@ -16,10 +16,16 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
-#include <utils/bit_utils.h>
 #include "sys/mem_pool.h"
+#include "sys/mem_tracker.h"
+#include "sys/syscall_exception.h"
+#include "sys/utils.h"
+#include <sys/mman.h>
 SYS_NAMESPACE_BEGIN
 
+// MAP_HUGETLB时映射的长度须是大页大小的整数倍，按x86_64默认的2MB对齐
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 CRawMemPool::CRawMemPool() throw ()
     :_use_heap(false)
     ,_guard_size(0)
@@ -27,10 +33,12 @@ CRawMemPool::CRawMemPool() throw ()
     ,_bucket_number(0)   
     ,_stack_top_index(0)
     ,_available_number(0)
+    ,_backing(MEM_POOL_HEAP)
+    ,_mapped_size(0)
+    ,_mem_tracker(NULL)
     ,_stack_top(NULL)
     ,_stack_bottom(NULL)
     ,_bucket_stack(NULL)
-    ,_bucket_bitmap(NULL)
 {
 }
 
@@ -41,6 +49,10 @@ CRawMemPool::~CRawMemPool() throw ()
 
 void CRawMemPool::destroy() throw ()
 {
+    // 从堆上分配的无法知道还有多少未回收，只减去池中的
+    if ((_mem_tracker != NULL) && (_stack_bottom != NULL))
+        _mem_tracker->release(static_cast<size_t>(_bucket_size) * (_bucket_number - _available_number));
+
     _use_heap = false;
     _guard_size = 0;
     _bucket_size = 0;
@@ -50,22 +62,23 @@ void CRawMemPool::destroy() throw ()
 
     if (_stack_bottom != NULL)
     {
-        delete []_stack_bottom;
+        if (_mapped_size > 0)
+            (void)munmap(_stack_bottom, _mapped_size);
+        else
+            delete []_stack_bottom;
         _stack_bottom = NULL;
     }
+    _backing = MEM_POOL_HEAP;
+    _mapped_size = 0;
     if (_bucket_stack != NULL)
     {
         delete []_bucket_stack;
         _bucket_stack = NULL;
     }
-    if (_bucket_bitmap != NULL)
-    {
-        delete []_bucket_bitmap;
-        _bucket_bitmap = NULL;
-    }
+    _bucket_bitmap.resize(0);
 }
 
-void CRawMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag) throw ()
+void CRawMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag, int numa_node, uint32_t backing) throw ()
 {
     // 释放之前已经创建的
     destroy();
@@ -78,29 +91,43 @@ void CRawMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_
 
     // 有了guard_size更容易分析出是否有内存越界之类的行为
     _bucket_size += _guard_size;
-    
-    _bucket_stack = new char*[bucket_number];
-    _stack_bottom = new char[_bucket_size * bucket_number];
-    _stack_top = _stack_bottom + _bucket_size * (bucket_number - 1);
-    _stack_top_index = bucket_number;
-    _available_number = bucket_number;
+
+    // 以size_t计算，避免超过4GB时溢出
+    const size_t pool_size = static_cast<size_t>(_bucket_size) * _bucket_number;
+    _bucket_stack = new char*[_bucket_number];
+    if (backing != MEM_POOL_HEAP)
+        _stack_bottom = map_memory(pool_size, numa_node, backing);
+    if (NULL == _stack_bottom)
+    {
+        _stack_bottom = new char[pool_size];
+
+        // 在memset首次访问之前绑定，页直接从指定节点分配
+        if (numa_node >= 0)
+            (void)CUtils::bind_numa_node(_stack_bottom, pool_size, numa_node);
+    }
+    _stack_top = _stack_bottom + static_cast<size_t>(_bucket_size) * (_bucket_number - 1);
+    _stack_top_index = _bucket_number;
+    _available_number = _bucket_number;
 
     // 设置警戒标识
-    memset(_stack_bottom, guard_flag, bucket_number * _bucket_size);
+    memset(_stack_bottom, guard_flag, pool_size);
     
     for (uint32_t i=0; i<_bucket_number; ++i)    
-        _bucket_stack[i] = _stack_bottom + _bucket_size * i; 
+        _bucket_stack[i] = _stack_bottom + static_cast<size_t>(_bucket_size) * i; 
         
-    // 初始化为1，加8是为了不四舍五入
-    _bucket_bitmap = new char[(bucket_number+8) / 8];
-    memset(_bucket_bitmap, 1, (bucket_number+8) / 8);
+    // 开始时都未分配
+    _bucket_bitmap.resize(_bucket_number);
 }
 
 void* CRawMemPool::allocate() throw ()
 {
     if (0 == _stack_top_index)
     {
-        return _use_heap? new char[_bucket_size]: NULL;
+        if (!_use_heap)
+            return NULL;
+        if (_mem_tracker != NULL)
+            _mem_tracker->allocate(_bucket_size);
+        return new char[_bucket_size];
     }
     else
     {        
@@ -108,7 +135,9 @@ void* CRawMemPool::allocate() throw ()
         char*  ptr = _bucket_stack[--_stack_top_index];
         uint32_t bitmap_index = (ptr - _stack_bottom) / _bucket_size;
 
-        utils::CBitUtils::set_bit(_bucket_bitmap, bitmap_index, false);  
+        _bucket_bitmap.set(bitmap_index);
+        if (_mem_tracker != NULL)
+            _mem_tracker->allocate(_bucket_size);
         return ptr;
     }
 }
@@ -121,6 +150,8 @@ bool CRawMemPool::reclaim(void* bucket) throw ()
     {
         if (_use_heap)
         {
+            if (_mem_tracker != NULL)
+                _mem_tracker->release(_bucket_size);
             delete []ptr;
             return true;
         }
@@ -134,11 +165,13 @@ bool CRawMemPool::reclaim(void* bucket) throw ()
     }
 
     uint32_t bitmap_index = (ptr - _stack_bottom) / _bucket_size;
-    if (utils::CBitUtils::test(_bucket_bitmap, bitmap_index))
+    if (_bucket_bitmap.test(bitmap_index))
     {
         ++_available_number;
         _bucket_stack[_stack_top_index++] = ptr;
-        utils::CBitUtils::set_bit(_bucket_bitmap, bitmap_index, true); 
+        _bucket_bitmap.reset(bitmap_index);
+        if (_mem_tracker != NULL)
+            _mem_tracker->release(_bucket_size);
     }
 
     return true;
@@ -169,33 +202,255 @@ uint32_t CRawMemPool::get_available_number() const throw ()
     return _available_number;
 }
 
+uint32_t CRawMemPool::get_backing() const throw ()
+{
+    return _backing;
+}
+
+char* CRawMemPool::map_memory(size_t size, int numa_node, uint32_t backing) throw ()
+{
+    // 指定了NUMA节点时，须先绑定再缺页，所以不能用MAP_POPULATE，改在绑定后以MADV_POPULATE_WRITE预缺页
+    const bool populate = (backing & MEM_POOL_POPULATE) != 0;
+    const int populate_flag = (populate && (numa_node < 0))? MAP_POPULATE: 0;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | populate_flag;
+    void* addr = MAP_FAILED;
+    size_t mapped_size = size;
+
+    _backing = MEM_POOL_MMAP | (backing & MEM_POOL_POPULATE);
+    if ((backing & MEM_POOL_HUGETLB) != 0)
+    {
+        mapped_size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        addr = mmap(NULL, mapped_size, PROT_READ|PROT_WRITE, flags|MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED)
+            _backing |= MEM_POOL_HUGETLB;
+        else
+            backing |= MEM_POOL_THP; // 预留的大页不够，退回普通页，但仍尽量使用透明大页
+    }
+    if (MAP_FAILED == addr)
+    {
+        mapped_size = size;
+        addr = mmap(NULL, mapped_size, PROT_READ|PROT_WRITE, flags, -1, 0);
+        if (MAP_FAILED == addr)
+        {
+            _backing = MEM_POOL_HEAP;
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        // 透明大页未开启（/sys/kernel/mm/transparent_hugepage/enabled为never）时失败，不影响使用
+        if (((backing & MEM_POOL_THP) != 0) && (0 == madvise(addr, mapped_size, MADV_HUGEPAGE)))
+            _backing |= MEM_POOL_THP;
+#endif // MADV_HUGEPAGE
+    }
+
+    if (numa_node >= 0)
+    {
+        (void)CUtils::bind_numa_node(addr, mapped_size, numa_node);
+#ifdef MADV_POPULATE_WRITE
+        // 内核5.14之前不支持，失败时由create中的memset完成缺页
+        if (populate)
+            (void)madvise(addr, mapped_size, MADV_POPULATE_WRITE);
+#endif // MADV_POPULATE_WRITE
+    }
+
+    _mapped_size = mapped_size;
+    return static_cast<char*>(addr);
+}
+
 //////////////////////////////////////////////////////////////////////////
 // CThreadMemPool
 
+CThreadMemPool::CThreadMemPool()
+    :_magazine_size(0)
+    ,_key_created(false)
+{
+    _lock.set_contention_name("mem_pool");
+}
+
+CThreadMemPool::~CThreadMemPool()
+{
+    destroy();
+}
+
 void CThreadMemPool::destroy()
 {
+    release_magazines();
+
     LockHelper<CLock> lock_helper(_lock);
     _raw_mem_pool.destroy();
 }
 
-void CThreadMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag)
+void CThreadMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag, uint32_t backing)
 {
     LockHelper<CLock> lock_helper(_lock);
-    _raw_mem_pool.create(bucket_size, bucket_number, use_heap, guard_size, guard_flag);
+    _raw_mem_pool.create(bucket_size, bucket_number, use_heap, guard_size, guard_flag, -1, backing);
 }
 
 void* CThreadMemPool::allocate()
 {
+    if (0 == _magazine_size)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        return _raw_mem_pool.allocate();
+    }
+
+    Magazine* magazine = get_magazine();
+    if (magazine->number > 0)
+    {
+        ++magazine->hit_number;
+        return magazine->buckets[--magazine->number];
+    }
+
+    // 弹匣为空，一次取半个弹匣
+    ++magazine->miss_number;
     LockHelper<CLock> lock_helper(_lock);
-    return _raw_mem_pool.allocate();
+    const uint32_t batch = (_magazine_size + 1) / 2;
+    while ((magazine->number < batch) && (_raw_mem_pool.get_available_number() > 0))
+        magazine->buckets[magazine->number++] = _raw_mem_pool.allocate();
+
+    // 池中已无可用的，按use_heap决定是否从堆上分配
+    return (magazine->number > 0)? magazine->buckets[--magazine->number]: _raw_mem_pool.allocate();
 }
 
 bool CThreadMemPool::reclaim(void* bucket)
 {
+    if (0 == _magazine_size)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        return _raw_mem_pool.reclaim(bucket);
+    }
+
+    Magazine* magazine = get_magazine();
+    if (magazine->number < _magazine_size)
+    {
+        ++magazine->hit_number;
+        magazine->buckets[magazine->number++] = bucket;
+        return true;
+    }
+
+    // 弹匣已满，一次还掉半个弹匣
+    ++magazine->miss_number;
     LockHelper<CLock> lock_helper(_lock);
+    flush_magazine(magazine, (_magazine_size + 1) / 2);
     return _raw_mem_pool.reclaim(bucket);
 }
 
+void CThreadMemPool::enable_thread_cache(uint32_t magazine_size)
+{
+    release_magazines();
+    if (magazine_size > 0)
+    {
+        const int errcode = pthread_key_create(&_magazine_key, on_thread_exit);
+        if (errcode != 0)
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_key_create");
+
+        _key_created = true;
+        _magazine_size = magazine_size;
+    }
+}
+
+thread_cache_stat_t CThreadMemPool::get_thread_cache_stat() const
+{
+    thread_cache_stat_t stat;
+    memset(&stat, 0, sizeof(stat));
+
+    if (_key_created)
+    {
+        const Magazine* magazine = static_cast<Magazine*>(pthread_getspecific(_magazine_key));
+        if (magazine != NULL)
+        {
+            stat.hit_number = magazine->hit_number;
+            stat.miss_number = magazine->miss_number;
+            stat.cached_number = magazine->number;
+        }
+    }
+
+    return stat;
+}
+
+thread_cache_stat_t CThreadMemPool::get_total_cache_stat() const
+{
+    thread_cache_stat_t stat;
+    memset(&stat, 0, sizeof(stat));
+
+    // 其它线程的计数可能正在变化，结果仅供参考
+    LockHelper<CLock> lock_helper(_lock);
+    for (std::vector<Magazine*>::size_type i=0; i<_magazines.size(); ++i)
+    {
+        stat.hit_number += _magazines[i]->hit_number;
+        stat.miss_number += _magazines[i]->miss_number;
+        stat.cached_number += _magazines[i]->number;
+    }
+
+    return stat;
+}
+
+void CThreadMemPool::on_thread_exit(void* param)
+{
+    Magazine* magazine = static_cast<Magazine*>(param);
+    CThreadMemPool* pool = magazine->pool;
+    LockHelper<CLock> lock_helper(pool->_lock);
+
+    pool->flush_magazine(magazine, magazine->number);
+    for (std::vector<Magazine*>::iterator iter=pool->_magazines.begin(); iter!=pool->_magazines.end(); ++iter)
+    {
+        if (*iter == magazine)
+        {
+            pool->_magazines.erase(iter);
+            break;
+        }
+    }
+
+    delete []magazine->buckets;
+    delete magazine;
+}
+
+CThreadMemPool::Magazine* CThreadMemPool::get_magazine()
+{
+    Magazine* magazine = static_cast<Magazine*>(pthread_getspecific(_magazine_key));
+    if (NULL == magazine)
+    {
+        magazine = new Magazine;
+        magazine->pool = this;
+        magazine->number = 0;
+        magazine->hit_number = 0;
+        magazine->miss_number = 0;
+        magazine->buckets = new void*[_magazine_size];
+        pthread_setspecific(_magazine_key, magazine);
+
+        LockHelper<CLock> lock_helper(_lock);
+        _magazines.push_back(magazine);
+    }
+
+    return magazine;
+}
+
+// 调用者需持有_lock
+void CThreadMemPool::flush_magazine(Magazine* magazine, uint32_t number)
+{
+    for (uint32_t i=0; (i<number) && (magazine->number>0); ++i)
+        _raw_mem_pool.reclaim(magazine->buckets[--magazine->number]);
+}
+
+void CThreadMemPool::release_magazines()
+{
+    if (_key_created)
+    {
+        // 删除key后，线程退出时不再回调on_thread_exit，所以这里释放所有弹匣
+        pthread_key_delete(_magazine_key);
+        _key_created = false;
+        _magazine_size = 0;
+
+        LockHelper<CLock> lock_helper(_lock);
+        for (std::vector<Magazine*>::size_type i=0; i<_magazines.size(); ++i)
+        {
+            flush_magazine(_magazines[i], _magazines[i]->number);
+            delete []_magazines[i]->buckets;
+            delete _magazines[i];
+        }
+        _magazines.clear();
+    }
+}
+
 bool CThreadMemPool::use_heap() const throw ()
 {
     return _raw_mem_pool.use_heap();
@@ -221,4 +476,10 @@ uint32_t CThreadMemPool::get_available_number() const throw ()
     return _raw_mem_pool.get_available_number();
 }
 
+void CThreadMemPool::set_mem_tracker(CMemTracker* mem_tracker)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    _raw_mem_pool.set_mem_tracker(mem_tracker);
+}
+
 SYS_NAMESPACE_END
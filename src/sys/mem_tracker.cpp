@@ -0,0 +1,129 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/mem_tracker.h"
+#include "sys/metrics.h"
+#include <malloc.h>
+#include <map>
+SYS_NAMESPACE_BEGIN
+
+// mallinfo2在glibc 2.33引入，mallinfo的int字段超过2GB时会溢出
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 33)))
+#define MOOON_HAVE_MALLINFO2 1
+#endif
+
+static CLock sg_trackers_lock;
+static std::map<std::string, CMemTracker*>* sg_trackers = NULL; // 不释放，以便其它全局对象析构时仍可使用
+
+CMemTracker* CMemTracker::get_tracker(const std::string& tag)
+{
+    LockHelper<CLock> lock_helper(sg_trackers_lock);
+    if (NULL == sg_trackers)
+        sg_trackers = new std::map<std::string, CMemTracker*>;
+
+    CMemTracker*& tracker = (*sg_trackers)[tag];
+    if (NULL == tracker)
+        tracker = new CMemTracker(tag);
+    return tracker;
+}
+
+void CMemTracker::get_trackers(std::vector<CMemTracker*>* trackers)
+{
+    trackers->clear();
+
+    LockHelper<CLock> lock_helper(sg_trackers_lock);
+    if (sg_trackers != NULL)
+    {
+        for (std::map<std::string, CMemTracker*>::const_iterator iter=sg_trackers->begin(); iter!=sg_trackers->end(); ++iter)
+            trackers->push_back(iter->second);
+    }
+}
+
+int64_t CMemTracker::get_tracked_bytes()
+{
+    std::vector<CMemTracker*> trackers;
+    int64_t bytes = 0;
+
+    get_trackers(&trackers);
+    for (std::vector<CMemTracker*>::size_type i=0; i<trackers.size(); ++i)
+        bytes += trackers[i]->get_bytes();
+    return bytes;
+}
+
+void CMemTracker::enable_malloc_sampling()
+{
+    CMetricsRegistry::get_singleton()->add_collector(&CMemTracker::collect, NULL);
+}
+
+bool CMemTracker::sample_malloc()
+{
+    static CGauge* malloc_gauge = CMetricsRegistry::get_singleton()->get_gauge("mem.malloc.bytes");
+    static CGauge* mmap_gauge = CMetricsRegistry::get_singleton()->get_gauge("mem.malloc.mmap_bytes");
+    static CGauge* untracked_gauge = CMetricsRegistry::get_singleton()->get_gauge("mem.untracked.bytes");
+
+#if MOOON_HAVE_MALLINFO2 == 1
+    // uordblks为brk堆和各arena中在用的，hblkhd为大块直接mmap的
+    const struct mallinfo2 info = mallinfo2();
+    const int64_t malloc_bytes = static_cast<int64_t>(info.uordblks + info.hblkhd);
+
+    malloc_gauge->set(malloc_bytes);
+    mmap_gauge->set(static_cast<int64_t>(info.hblkhd));
+    untracked_gauge->set(malloc_bytes - get_tracked_bytes());
+    return true;
+#else
+    malloc_gauge->set(0);
+    mmap_gauge->set(0);
+    untracked_gauge->set(0);
+    return false;
+#endif // MOOON_HAVE_MALLINFO2
+}
+
+void CMemTracker::collect(void* context)
+{
+    (void)sample_malloc();
+}
+
+CMemTracker::CMemTracker(const std::string& tag)
+    : _tag(tag)
+{
+    _bytes = CMetricsRegistry::get_singleton()->get_gauge(std::string("mem.") + tag + ".bytes");
+    _peak = CMetricsRegistry::get_singleton()->get_gauge(std::string("mem.") + tag + ".peak");
+}
+
+void CMemTracker::allocate(size_t size)
+{
+    const int64_t bytes = _bytes->add(static_cast<int64_t>(size));
+    _peak->update_max(bytes);
+}
+
+void CMemTracker::release(size_t size)
+{
+    _bytes->add(-static_cast<int64_t>(size));
+}
+
+int64_t CMemTracker::get_bytes() const
+{
+    return _bytes->get();
+}
+
+int64_t CMemTracker::get_peak() const
+{
+    return _peak->get();
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,531 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/metrics.h"
+#include "sys/log.h"
+#include "sys/thread_engine.h"
+#include "sys/utils.h"
+#include "utils/string_utils.h"
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+SYS_NAMESPACE_BEGIN
+
+// 最多的分片数
+#define METRICS_SHARD_MAX 8
+
+// 每个2的幂区间分成的桶数为2^HISTOGRAM_SUB_BITS
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_NUMBER (1 << HISTOGRAM_SUB_BITS)
+
+// 支持的最大值为2^HISTOGRAM_MAX_BITS-1
+#define HISTOGRAM_MAX_BITS 44
+#define HISTOGRAM_BUCKET_NUMBER ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_NUMBER)
+
+// 线程的分片序号，线程第一次更新度量时分配，同一线程总是使用同一个分片
+static __thread int sg_metrics_slot = -1;
+static uint32_t sg_next_metrics_slot = 0;
+
+static inline uint32_t get_metrics_slot()
+{
+    if (-1 == sg_metrics_slot)
+        sg_metrics_slot = static_cast<int>(__atomic_fetch_add(&sg_next_metrics_slot, 1, __ATOMIC_RELAXED) & INT_MAX);
+    return static_cast<uint32_t>(sg_metrics_slot);
+}
+
+// 分片数取CPU个数向上取2的幂，不超过METRICS_SHARD_MAX
+static uint32_t get_shard_number()
+{
+    static const uint32_t cpu_number = CUtils::get_cpu_number();
+    uint32_t number = 1;
+    while ((number < cpu_number) && (number < METRICS_SHARD_MAX))
+        number <<= 1;
+    return number;
+}
+
+static void* alloc_aligned(size_t size)
+{
+    void* memory = NULL;
+    int errcode = posix_memalign(&memory, CACHE_LINE_SIZE, size);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "posix_memalign");
+
+    memset(memory, 0, size);
+    return memory;
+}
+
+static void atomic_min(uint64_t* target, uint64_t value)
+{
+    uint64_t current = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while ((value < current)
+       && !__atomic_compare_exchange_n(target, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void atomic_max(uint64_t* target, uint64_t value)
+{
+    uint64_t current = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while ((value > current)
+       && !__atomic_compare_exchange_n(target, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CCounter::CCounter()
+{
+    const uint32_t number = get_shard_number();
+    _shards = static_cast<Shard*>(alloc_aligned(sizeof(Shard) * number));
+    _shard_mask = number - 1;
+}
+
+CCounter::~CCounter()
+{
+    free(_shards);
+}
+
+void CCounter::inc(uint64_t number)
+{
+    __atomic_add_fetch(&_shards[get_metrics_slot() & _shard_mask].value, number, __ATOMIC_RELAXED);
+}
+
+uint64_t CCounter::get() const
+{
+    uint64_t value = 0;
+    for (uint32_t i=0; i<=_shard_mask; ++i)
+        value += __atomic_load_n(&_shards[i].value, __ATOMIC_RELAXED);
+    return value;
+}
+
+void CCounter::reset()
+{
+    for (uint32_t i=0; i<=_shard_mask; ++i)
+        __atomic_store_n(&_shards[i].value, 0, __ATOMIC_RELAXED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CHistogramSnapshot::CHistogramSnapshot()
+    : _buckets(HISTOGRAM_BUCKET_NUMBER, 0), _count(0), _sum(0), _min(UINT64_MAX), _max(0)
+{
+}
+
+void CHistogramSnapshot::clear()
+{
+    _buckets.assign(HISTOGRAM_BUCKET_NUMBER, 0);
+    _count = 0;
+    _sum = 0;
+    _min = UINT64_MAX;
+    _max = 0;
+}
+
+void CHistogramSnapshot::merge(const CHistogramSnapshot& other)
+{
+    for (uint32_t i=0; i<HISTOGRAM_BUCKET_NUMBER; ++i)
+        _buckets[i] += other._buckets[i];
+    _count += other._count;
+    _sum += other._sum;
+    if (other._min < _min)
+        _min = other._min;
+    if (other._max > _max)
+        _max = other._max;
+}
+
+uint64_t CHistogramSnapshot::get_percentile(double percentile) const
+{
+    if (0 == _count)
+        return 0;
+
+    // 第rank个值（从1开始）所在的桶
+    uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100 * static_cast<double>(_count)));
+    if (rank < 1)
+        rank = 1;
+    else if (rank > _count)
+        rank = _count;
+
+    uint64_t total = 0;
+    for (uint32_t i=0; i<HISTOGRAM_BUCKET_NUMBER; ++i)
+    {
+        total += _buckets[i];
+        if (total >= rank)
+        {
+            const uint64_t value = CLatencyHistogram::get_bucket_upper_bound(i);
+            if (value > _max)
+                return _max;
+            return (value < _min)? _min: value;
+        }
+    }
+
+    return _max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CLatencyHistogram::CLatencyHistogram()
+{
+    const uint32_t number = get_shard_number();
+    _shards = new Shard*[number];
+    for (uint32_t i=0; i<number; ++i)
+    {
+        _shards[i] = static_cast<Shard*>(alloc_aligned(offsetof(Shard, buckets) + sizeof(uint64_t)*HISTOGRAM_BUCKET_NUMBER));
+        _shards[i]->min = UINT64_MAX;
+    }
+    _shard_mask = number - 1;
+}
+
+CLatencyHistogram::~CLatencyHistogram()
+{
+    for (uint32_t i=0; i<=_shard_mask; ++i)
+        free(_shards[i]);
+    delete []_shards;
+}
+
+void CLatencyHistogram::record(uint64_t value)
+{
+    Shard* shard = _shards[get_metrics_slot() & _shard_mask];
+
+    __atomic_add_fetch(&shard->buckets[get_bucket_index(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shard->sum, value, __ATOMIC_RELAXED);
+    atomic_min(&shard->min, value);
+    atomic_max(&shard->max, value);
+}
+
+void CLatencyHistogram::get_snapshot(CHistogramSnapshot* snapshot, bool reset)
+{
+    snapshot->clear();
+
+    for (uint32_t i=0; i<=_shard_mask; ++i)
+    {
+        Shard* shard = _shards[i];
+        for (uint32_t j=0; j<HISTOGRAM_BUCKET_NUMBER; ++j)
+        {
+            const uint64_t number = reset? __atomic_exchange_n(&shard->buckets[j], 0, __ATOMIC_RELAXED)
+                                         : __atomic_load_n(&shard->buckets[j], __ATOMIC_RELAXED);
+            snapshot->_buckets[j] += number;
+            snapshot->_count += number;
+        }
+
+        const uint64_t sum = reset? __atomic_exchange_n(&shard->sum, 0, __ATOMIC_RELAXED): __atomic_load_n(&shard->sum, __ATOMIC_RELAXED);
+        const uint64_t min = reset? __atomic_exchange_n(&shard->min, UINT64_MAX, __ATOMIC_RELAXED): __atomic_load_n(&shard->min, __ATOMIC_RELAXED);
+        const uint64_t max = reset? __atomic_exchange_n(&shard->max, 0, __ATOMIC_RELAXED): __atomic_load_n(&shard->max, __ATOMIC_RELAXED);
+        snapshot->_sum += sum;
+        if (min < snapshot->_min)
+            snapshot->_min = min;
+        if (max > snapshot->_max)
+            snapshot->_max = max;
+    }
+}
+
+uint32_t CLatencyHistogram::get_bucket_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_NUMBER)
+        return static_cast<uint32_t>(value);
+    if (value >> HISTOGRAM_MAX_BITS)
+        return HISTOGRAM_BUCKET_NUMBER - 1;
+
+    // 最高位为第exponent位，其后的HISTOGRAM_SUB_BITS位为桶在区间内的序号
+    const uint32_t exponent = 63 - __builtin_clzll(value);
+    const uint32_t sub = static_cast<uint32_t>(value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_NUMBER - 1);
+    return ((exponent - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+uint64_t CLatencyHistogram::get_bucket_upper_bound(uint32_t index)
+{
+    if (index < HISTOGRAM_SUB_NUMBER)
+        return index;
+
+    const uint32_t shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    const uint64_t lower = static_cast<uint64_t>(HISTOGRAM_SUB_NUMBER + (index & (HISTOGRAM_SUB_NUMBER - 1))) << shift;
+    return lower + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CMetricsRegistry* CMetricsRegistry::get_singleton()
+{
+    // 不释放，以便其它全局对象析构时仍可使用
+    static CMetricsRegistry* registry = new CMetricsRegistry;
+    return registry;
+}
+
+CMetricsRegistry::CMetricsRegistry()
+    : _engine(NULL), _stop(false), _interval_seconds(0), _reporter(NULL), _context(NULL)
+{
+}
+
+CCounter* CMetricsRegistry::get_counter(const std::string& name)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    CCounter*& counter = _counters[name];
+    if (NULL == counter)
+        counter = new CCounter;
+    return counter;
+}
+
+CGauge* CMetricsRegistry::get_gauge(const std::string& name)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    CGauge*& gauge = _gauges[name];
+    if (NULL == gauge)
+        gauge = new CGauge;
+    return gauge;
+}
+
+CLatencyHistogram* CMetricsRegistry::get_histogram(const std::string& name)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    CLatencyHistogram*& histogram = _histograms[name];
+    if (NULL == histogram)
+        histogram = new CLatencyHistogram;
+    return histogram;
+}
+
+// 先以驻留的名字查找，找不到时按名字创建或取得已有的，再记下
+template <class Metric>
+static Metric* get_interned_metric(CLock& lock, utils::CFlatHashMap<CInternedString, Metric*>* interned_metrics, std::map<std::string, Metric*>* metrics, const CInternedString& name)
+{
+    LockHelper<CLock> lock_helper(lock);
+    Metric*& interned_metric = (*interned_metrics)[name];
+    if (NULL == interned_metric)
+    {
+        Metric*& metric = (*metrics)[name.str()];
+        if (NULL == metric)
+            metric = new Metric;
+        interned_metric = metric;
+    }
+    return interned_metric;
+}
+
+CCounter* CMetricsRegistry::get_counter(const CInternedString& name)
+{
+    return get_interned_metric(_lock, &_interned_counters, &_counters, name);
+}
+
+CGauge* CMetricsRegistry::get_gauge(const CInternedString& name)
+{
+    return get_interned_metric(_lock, &_interned_gauges, &_gauges, name);
+}
+
+CLatencyHistogram* CMetricsRegistry::get_histogram(const CInternedString& name)
+{
+    return get_interned_metric(_lock, &_interned_histograms, &_histograms, name);
+}
+
+void CMetricsRegistry::add_collector(metrics_collector_t collector, void* context)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    const std::pair<metrics_collector_t, void*> item(collector, context);
+    for (std::vector<std::pair<metrics_collector_t, void*> >::size_type i=0; i<_collectors.size(); ++i)
+    {
+        if (_collectors[i] == item)
+            return;
+    }
+    _collectors.push_back(item);
+}
+
+void CMetricsRegistry::get_snapshot(MetricsSnapshot* snapshot, bool reset_histograms)
+{
+    snapshot->counters.clear();
+    snapshot->gauges.clear();
+    snapshot->histograms.clear();
+
+    // 回调中可能创建度量，所以不能在持有_lock时调用
+    std::vector<std::pair<metrics_collector_t, void*> > collectors;
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        collectors = _collectors;
+    }
+    for (std::vector<std::pair<metrics_collector_t, void*> >::size_type i=0; i<collectors.size(); ++i)
+        (*collectors[i].first)(collectors[i].second);
+
+    LockHelper<CLock> lock_helper(_lock);
+    for (std::map<std::string, CCounter*>::const_iterator iter=_counters.begin(); iter!=_counters.end(); ++iter)
+        snapshot->counters[iter->first] = iter->second->get();
+    for (std::map<std::string, CGauge*>::const_iterator iter=_gauges.begin(); iter!=_gauges.end(); ++iter)
+        snapshot->gauges[iter->first] = iter->second->get();
+    for (std::map<std::string, CLatencyHistogram*>::const_iterator iter=_histograms.begin(); iter!=_histograms.end(); ++iter)
+        iter->second->get_snapshot(&snapshot->histograms[iter->first], reset_histograms);
+}
+
+void CMetricsRegistry::start(uint32_t interval_seconds, metrics_reporter_t reporter, void* context)
+{
+    LockHelper<CLock> lock_helper(_thread_lock);
+    if (_engine != NULL)
+        return;
+
+    _stop = false;
+    _interval_seconds = (0 == interval_seconds)? 1: interval_seconds;
+    _reporter = reporter;
+    _context = context;
+    _engine = new CThreadEngine(bind(&CMetricsRegistry::run, this));
+}
+
+void CMetricsRegistry::stop()
+{
+    CThreadEngine* engine;
+    {
+        LockHelper<CLock> lock_helper(_thread_lock);
+        engine = _engine;
+        _engine = NULL;
+        _stop = true;
+        _thread_event.signal();
+    }
+
+    // 析构时等待线程退出
+    delete engine;
+}
+
+void CMetricsRegistry::get_last_snapshot(MetricsSnapshot* snapshot) const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    *snapshot = _last_snapshot;
+}
+
+std::string CMetricsRegistry::to_string(const MetricsSnapshot& snapshot)
+{
+    std::string str;
+
+    for (std::map<std::string, uint64_t>::const_iterator iter=snapshot.counters.begin(); iter!=snapshot.counters.end(); ++iter)
+        str += utils::CStringUtils::format_string("%s %" PRIu64"\n", iter->first.c_str(), iter->second);
+    for (std::map<std::string, int64_t>::const_iterator iter=snapshot.gauges.begin(); iter!=snapshot.gauges.end(); ++iter)
+        str += utils::CStringUtils::format_string("%s %" PRId64"\n", iter->first.c_str(), iter->second);
+    for (std::map<std::string, CHistogramSnapshot>::const_iterator iter=snapshot.histograms.begin(); iter!=snapshot.histograms.end(); ++iter)
+    {
+        const CHistogramSnapshot& histogram = iter->second;
+        str += utils::CStringUtils::format_string(
+            "%s count=%" PRIu64" mean=%" PRIu64" p50=%" PRIu64" p99=%" PRIu64" p999=%" PRIu64" max=%" PRIu64"\n",
+            iter->first.c_str(), histogram.get_count(), histogram.get_mean(),
+            histogram.get_percentile(50), histogram.get_percentile(99), histogram.get_percentile(99.9), histogram.get_max());
+    }
+
+    return str;
+}
+
+// Prometheus的名字只能包含[a-zA-Z0-9_:]，且不能以数字开头
+static std::string to_prometheus_name(const std::string& name)
+{
+    std::string result;
+    if (!name.empty() && (name[0] >= '0') && (name[0] <= '9'))
+        result.push_back('_');
+    for (std::string::size_type i=0; i<name.size(); ++i)
+    {
+        const char c = name[i];
+        if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || ('_' == c) || (':' == c))
+            result.push_back(c);
+        else
+            result.push_back('_');
+    }
+    return result;
+}
+
+std::string CMetricsRegistry::to_prometheus(const MetricsSnapshot& snapshot)
+{
+    std::string str;
+
+    for (std::map<std::string, uint64_t>::const_iterator iter=snapshot.counters.begin(); iter!=snapshot.counters.end(); ++iter)
+    {
+        const std::string name = to_prometheus_name(iter->first);
+        str += utils::CStringUtils::format_string("# TYPE %s counter\n%s %" PRIu64"\n", name.c_str(), name.c_str(), iter->second);
+    }
+    for (std::map<std::string, int64_t>::const_iterator iter=snapshot.gauges.begin(); iter!=snapshot.gauges.end(); ++iter)
+    {
+        const std::string name = to_prometheus_name(iter->first);
+        str += utils::CStringUtils::format_string("# TYPE %s gauge\n%s %" PRId64"\n", name.c_str(), name.c_str(), iter->second);
+    }
+    for (std::map<std::string, CHistogramSnapshot>::const_iterator iter=snapshot.histograms.begin(); iter!=snapshot.histograms.end(); ++iter)
+    {
+        const std::string name = to_prometheus_name(iter->first);
+        const CHistogramSnapshot& histogram = iter->second;
+        str += utils::CStringUtils::format_string(
+            "# TYPE %s summary\n"
+            "%s{quantile=\"0.5\"} %" PRIu64"\n"
+            "%s{quantile=\"0.99\"} %" PRIu64"\n"
+            "%s{quantile=\"0.999\"} %" PRIu64"\n"
+            "%s_sum %" PRIu64"\n"
+            "%s_count %" PRIu64"\n",
+            name.c_str(),
+            name.c_str(), histogram.get_percentile(50),
+            name.c_str(), histogram.get_percentile(99),
+            name.c_str(), histogram.get_percentile(99.9),
+            name.c_str(), histogram.get_sum(),
+            name.c_str(), histogram.get_count());
+    }
+
+    return str;
+}
+
+std::string CMetricsRegistry::to_json(const MetricsSnapshot& snapshot)
+{
+    std::string str;
+    {
+        utils::CJsonWriter writer(&str);
+        to_json(snapshot, &writer);
+    }
+    return str;
+}
+
+void CMetricsRegistry::to_json(const MetricsSnapshot& snapshot, utils::CJsonWriter* writer)
+{
+    writer->begin_object();
+    writer->key("counters");
+    utils::json_value(writer, snapshot.counters);
+    writer->key("gauges");
+    utils::json_value(writer, snapshot.gauges);
+
+    writer->key("histograms").begin_object();
+    for (std::map<std::string, CHistogramSnapshot>::const_iterator iter=snapshot.histograms.begin(); iter!=snapshot.histograms.end(); ++iter)
+    {
+        const CHistogramSnapshot& histogram = iter->second;
+        writer->key(iter->first).begin_object();
+        writer->key("count").value(histogram.get_count());
+        writer->key("sum").value(histogram.get_sum());
+        writer->key("mean").value(histogram.get_mean());
+        writer->key("min").value(histogram.get_min());
+        writer->key("p50").value(histogram.get_percentile(50));
+        writer->key("p99").value(histogram.get_percentile(99));
+        writer->key("p999").value(histogram.get_percentile(99.9));
+        writer->key("max").value(histogram.get_max());
+        writer->end_object();
+    }
+    writer->end_object();
+    writer->end_object();
+}
+
+void CMetricsRegistry::run()
+{
+    for (;;)
+    {
+        {
+            LockHelper<CLock> lock_helper(_thread_lock);
+            if (!_stop)
+                (void)_thread_event.timed_wait(_thread_lock, _interval_seconds * 1000);
+            if (_stop)
+                break;
+        }
+
+        MetricsSnapshot snapshot;
+        get_snapshot(&snapshot, true);
+        if (NULL == _reporter)
+            MYLOG_INFO("metrics:\n%s", to_string(snapshot).c_str());
+        else
+            (*_reporter)(snapshot, _context);
+
+        LockHelper<CLock> lock_helper(_lock);
+        _last_snapshot.counters.swap(snapshot.counters);
+        _last_snapshot.gauges.swap(snapshot.gauges);
+        _last_snapshot.histograms.swap(snapshot.histograms);
+    }
+}
+
+SYS_NAMESPACE_END
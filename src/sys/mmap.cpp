@@ -17,55 +17,57 @@
  * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
  */
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include "sys/mmap.h"
+#include <algorithm>
 SYS_NAMESPACE_BEGIN
 
-mmap_t* CMMap::map_read(const char* filename, size_t size_max)
+mmap_t* CMMap::map_read(const char* filename, size_t size_max, int map_flags)
 {
     int fd = open(filename, O_RDONLY);
     if (-1 == fd)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
     
-    return do_map(PROT_READ, fd, 0, 0, size_max, false);
+    return do_map(PROT_READ, fd, 0, 0, size_max, map_flags, false);
 }
 
-mmap_t* CMMap::map_read(int fd, size_t size, size_t offset, size_t size_max)
+mmap_t* CMMap::map_read(int fd, size_t size, size_t offset, size_t size_max, int map_flags)
 {
-    return do_map(PROT_READ, fd, size, offset, size_max, true);
+    return do_map(PROT_READ, fd, size, offset, size_max, map_flags, true);
 }
 
-mmap_t* CMMap::map_write(const char* filename, size_t size_max)
+mmap_t* CMMap::map_write(const char* filename, size_t size_max, int map_flags)
 {
-    int fd = open(filename, O_WRONLY);
+    int fd = open(filename, O_RDWR); // mmap要求文件总是以可读的方式打开
     if (-1 == fd)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
     
-    return do_map(PROT_WRITE, fd, 0, 0, size_max, false);
+    return do_map(PROT_WRITE, fd, 0, 0, size_max, map_flags, false);
 }
 
-mmap_t* CMMap::map_write(int fd, size_t size, size_t offset, size_t size_max)
+mmap_t* CMMap::map_write(int fd, size_t size, size_t offset, size_t size_max, int map_flags)
 {
-    return do_map(PROT_WRITE, fd, size, offset, size_max, true);
+    return do_map(PROT_WRITE, fd, size, offset, size_max, map_flags, true);
 }
 
-mmap_t* CMMap::map_both(const char* filename, size_t size_max)
+mmap_t* CMMap::map_both(const char* filename, size_t size_max, int map_flags)
 {
-    int fd = open(filename, O_RDONLY|O_WRONLY);
+    int fd = open(filename, O_RDWR);
     if (-1 == fd)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
     
-    return do_map(PROT_READ|PROT_WRITE, fd, 0, 0, size_max, false);
+    return do_map(PROT_READ|PROT_WRITE, fd, 0, 0, size_max, map_flags, false);
 }
 
-mmap_t* CMMap::map_both(int fd, size_t size, size_t offset, size_t size_max)
+mmap_t* CMMap::map_both(int fd, size_t size, size_t offset, size_t size_max, int map_flags)
 {
-    return do_map(PROT_READ|PROT_WRITE, fd, size, offset, size_max, true);
+    return do_map(PROT_READ|PROT_WRITE, fd, size, offset, size_max, map_flags, true);
 }
 
-mmap_t* CMMap::do_map(int prot, int fd, size_t size, size_t offset, size_t size_max, bool byfd)
+mmap_t* CMMap::do_map(int prot, int fd, size_t size, size_t offset, size_t size_max, int map_flags, bool byfd)
 {
 	mmap_t* ptr = new mmap_t;
 
@@ -76,12 +78,16 @@ mmap_t* CMMap::do_map(int prot, int fd, size_t size, size_t offset, size_t size_
             THROW_SYSCALL_EXCEPTION(NULL, errno, "fstat");
 		
         ptr->fd = byfd? -fd: fd;
-        ptr->len = (0 == size)? ((size_t)st.st_size-offset): (size+offset > (size_t)st.st_size)? (size_t)st.st_size: (size+offset);
+        if (offset > (size_t)st.st_size)
+            THROW_SYSCALL_EXCEPTION(NULL, EINVAL, NULL);
+
+        // 从offset开始映射，不超过文件尾
+        ptr->len = ((0 == size) || (size+offset > (size_t)st.st_size))? ((size_t)st.st_size-offset): size;
 		ptr->addr = NULL;
 
 		if ((0 == size_max) || (ptr->len < size_max))
 		{
-			void* addr = mmap(NULL, ptr->len, prot, MAP_SHARED, fd, offset);
+			void* addr = mmap(NULL, ptr->len, prot, MAP_SHARED|map_flags, fd, offset);
 			if (MAP_FAILED == addr)
 			    THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
 
@@ -144,4 +150,144 @@ void CMMap::async_flush(mmap_t* ptr, size_t offset, size_t length, bool invalid)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "msync");
 }
 
+void CMMap::advise(mmap_t* ptr, int advice, size_t offset, size_t length)
+{
+    if ((NULL == ptr->addr) || (offset >= ptr->len))
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, NULL);
+
+    // madvise要求地址页对齐，mmap返回的地址总是页对齐的
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t aligned_offset = offset - offset%page_size;
+    const size_t end = ((0 == length) || (offset+length > ptr->len))? ptr->len: offset+length;
+    if (-1 == madvise(((char*)(ptr->addr))+aligned_offset, end-aligned_offset, advice))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "madvise");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CMappedReader::CMappedReader(const char* filename, size_t window_size, int flags)
+    : _fd(-1), _flags(flags), _file_size(0), _window_size(0),
+      _window(NULL), _window_offset(0), _window_len(0), _offset(0), _dropped_offset(0), _remap_number(0)
+{
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    _window_size = (0 == window_size)? page_size: (window_size+page_size-1) / page_size * page_size;
+
+    _fd = open(filename, O_RDONLY);
+    if (-1 == _fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
+
+    struct stat st;
+    if (-1 == fstat(_fd, &st))
+    {
+        int errcode = errno;
+        close(_fd);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "fstat");
+    }
+
+    _file_size = static_cast<uint64_t>(st.st_size);
+    (void)posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+CMappedReader::~CMappedReader()
+{
+    unmap_window();
+    close(_fd);
+}
+
+void CMappedReader::seek(uint64_t offset)
+{
+    _offset = std::min(offset, _file_size);
+    _dropped_offset = std::min(_dropped_offset, _offset);
+}
+
+bool CMappedReader::next_line(const char** line, size_t* line_size)
+{
+    if (_offset >= _file_size)
+        return false;
+
+    for (size_t size=_window_size;; size*=2)
+    {
+        // 映射的窗口需包含_offset，并且之后至少还有一个字节
+        if ((_offset < _window_offset) || (_offset >= _window_offset+_window_len))
+            remap(_offset, size);
+
+        const char* begin = _window + (_offset-_window_offset);
+        const size_t available = static_cast<size_t>(_window_offset+_window_len-_offset);
+        const char* end = static_cast<const char*>(memchr(begin, '\n', available));
+        if (end != NULL)
+        {
+            *line = begin;
+            *line_size = static_cast<size_t>(end - begin);
+            _offset += *line_size + 1;
+            return true;
+        }
+
+        // 窗口已到文件尾，为没有换行符的最后一行
+        if (_window_offset+_window_len >= _file_size)
+        {
+            *line = begin;
+            *line_size = available;
+            _offset += available;
+            return true;
+        }
+
+        // 行跨越窗口尾，从行首重新映射，行超过窗口时扩大窗口
+        remap(_offset, std::max(size, available*2));
+    }
+}
+
+bool CMappedReader::next_record(const char** record, size_t record_size)
+{
+    if ((0 == record_size) || (_file_size-_offset < record_size))
+        return false;
+
+    if ((_offset < _window_offset) || (_offset+record_size > _window_offset+_window_len))
+        remap(_offset, std::max(_window_size, record_size));
+
+    *record = _window + (_offset-_window_offset);
+    _offset += record_size;
+    return true;
+}
+
+void CMappedReader::remap(uint64_t offset, size_t size)
+{
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t window_offset = offset - offset%page_size;
+    const size_t window_len = static_cast<size_t>(std::min(static_cast<uint64_t>(size)+(offset-window_offset), _file_size-window_offset));
+
+    unmap_window();
+    if ((_flags & reader_drop_behind) && (window_offset > _dropped_offset))
+    {
+        // 已读过的部分不会再读，从页缓存中丢弃，以免读大文件时挤出其它热数据
+        (void)posix_fadvise(_fd, static_cast<off_t>(_dropped_offset), static_cast<off_t>(window_offset-_dropped_offset), POSIX_FADV_DONTNEED);
+        _dropped_offset = window_offset;
+    }
+
+    const int map_flags = (_flags & reader_populate)? MAP_SHARED|MAP_POPULATE: MAP_SHARED;
+    void* addr = mmap(NULL, window_len, PROT_READ, map_flags, _fd, static_cast<off_t>(window_offset));
+    if (MAP_FAILED == addr)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+
+    (void)madvise(addr, window_len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (_flags & reader_hugepage)
+        (void)madvise(addr, window_len, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+
+    _window = static_cast<char*>(addr);
+    _window_offset = window_offset;
+    _window_len = window_len;
+    ++_remap_number;
+}
+
+void CMappedReader::unmap_window()
+{
+    if (_window != NULL)
+    {
+        (void)munmap(_window, _window_len);
+        _window = NULL;
+        _window_offset = 0;
+        _window_len = 0;
+    }
+}
+
 SYS_NAMESPACE_END
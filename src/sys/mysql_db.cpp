@@ -19,6 +19,7 @@
 #include "sys/mysql_db.h"
 #include "utils/scoped_ptr.h"
 #include "utils/string_formatter.h"
+#include "utils/string_simd.h"
 #include "utils/string_utils.h"
 
 #if MOOON_HAVE_MYSQL==1
@@ -28,7 +29,9 @@
 #include <mysql/mysql.h>
 #include <mysql/mysqld_error.h> // ER_QUERY_INTERRUPTED
 #include <stdarg.h>
+#include <stdlib.h>
 #include <strings.h>
+#include <type_traits>
 SYS_NAMESPACE_BEGIN
 
 // 将自己注释到CObjectFactdory中
@@ -88,17 +91,22 @@ bool CMySQLConnection::is_duplicate(int errcode)
 
 void CMySQLConnection::escape_string(const std::string& str, std::string* escaped_str)
 {
-    escaped_str->resize(str.size()*2+1, '\0');
-    int escaped_string_length = mysql_escape_string(const_cast<char*>(escaped_str->data()), str.c_str(), str.length());
-    if (escaped_string_length >= 0)
-        escaped_str->resize(escaped_string_length);
-    else
-        escaped_str->resize(0);
+    escaped_str->resize(get_escape_size(str.size()));
+    escaped_str->resize(utils::CStringSimd::escape_mysql(str.data(), str.size(), const_cast<char*>(escaped_str->data())));
+}
+
+// 这些字符集中须转义的字节不会出现在多字节字符的中间，可以逐字节转义，
+// gbk、big5和sjis等的第二个字节可能为反斜杠，须由mysql_real_escape_string处理
+static bool is_byte_escapable_charset(const char* charset)
+{
+    return (NULL != charset)
+        && ((0 == strcmp(charset, "utf8")) || (0 == strcmp(charset, "utf8mb4")) || (0 == strcmp(charset, "utf8mb3"))
+         || (0 == strcmp(charset, "latin1")) || (0 == strcmp(charset, "ascii")) || (0 == strcmp(charset, "binary")));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 CMySQLConnection::CMySQLConnection(size_t sql_max, bool multistatements)
-    : CDBConnectionBase(sql_max), _mysql_handle(NULL), _client_flag(0)
+    : CDBConnectionBase(sql_max), _mysql_handle(NULL), _client_flag(0), _local_infile(false)
 {
     // In MySQL 5.7, CLIENT_MULTI_RESULTS is enabled by default.
     if (multistatements)
@@ -206,48 +214,43 @@ bool CMySQLConnection::is_ipsock_exception(CDBException& db_error) const
     return CR_IPSOCK_ERROR == errcode;
 }
 
-std::string CMySQLConnection::escape_string(const std::string& str) const
+size_t CMySQLConnection::escape_string(const char* str, size_t size, char* escaped) const
 {
     MOOON_ASSERT(_mysql_handle != NULL);
-
     MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
-    int escaped_string_length = 0;
-    std::string escaped_string(str.size()*2+1, '\0');
 
-    if (NULL == _mysql_handle)
+    // NO_BACKSLASH_ESCAPES时反斜杠不是转义字符，交由mysql_real_escape_string处理（5.7.6之后会报错）
+    if ((NULL == mysql_handle) ||
+        (is_byte_escapable_charset(mysql_character_set_name(mysql_handle)) &&
+         (0 == (mysql_handle->server_status & SERVER_STATUS_NO_BACKSLASH_ESCAPES))))
     {
-        escaped_string_length = mysql_escape_string(
-            const_cast<char*>(escaped_string.data()), str.c_str(), str.length());
-    }
-    else
-    {
-        // #define MYSQL_SERVER_VERSION       "5.7.12"
-        // #define MYSQL_VERSION_ID            50712
-        // #define LIBMYSQL_VERSION           "5.7.12"  // 有些版本无此定义
-        // #define LIBMYSQL_VERSION_ID         50712    // 有些版本无此定义
-        // （启用NO_BACKSLASH_ESCAPES表示将反斜杠当作普通字符而不是转义字符）
-        // As of MySQL 5.7.6, mysql_real_escape_string() fails and produces an CR_INSECURE_API_ERR error if the NO_BACKSLASH_ESCAPES SQL mode is enabled.
-#if MYSQL_VERSION_ID < 50706
-            escaped_string_length = mysql_real_escape_string(
-                mysql_handle, const_cast<char*>(escaped_string.data()), str.c_str(), str.length());
-#else
-            escaped_string_length = mysql_real_escape_string(
-                mysql_handle, const_cast<char*>(escaped_string.data()), str.c_str(), str.length());
-#endif // MYSQL_VERSION_ID
+        return utils::CStringSimd::escape_mysql(str, size, escaped);
     }
 
-    if (escaped_string_length < 0)
+    // As of MySQL 5.7.6, mysql_real_escape_string() fails and produces an CR_INSECURE_API_ERR error if the NO_BACKSLASH_ESCAPES SQL mode is enabled.
+    const unsigned long escaped_string_length = mysql_real_escape_string(mysql_handle, escaped, str, static_cast<unsigned long>(size));
+    if (static_cast<unsigned long>(-1) == escaped_string_length)
     {
-        escaped_string.resize(0);
         throw CDBException(NULL,
                            mysql_error(mysql_handle), mysql_errno(mysql_handle),
                            __FILE__, __LINE__);
     }
-    else
-    {
-        escaped_string.resize(escaped_string_length);
-        return escaped_string;
-    }
+    return static_cast<size_t>(escaped_string_length);
+}
+
+std::string CMySQLConnection::escape_string(const std::string& str) const
+{
+    std::string escaped_string(get_escape_size(str.size())+1, '\0');
+    escaped_string.resize(escape_string(str.data(), str.size(), const_cast<char*>(escaped_string.data())));
+    return escaped_string;
+}
+
+// 直接转义到out的末尾，不产生临时字符串
+void CMySQLConnection::append_escaped_string(const char* str, size_t size, std::string* out) const
+{
+    const std::string::size_type offset = out->size();
+    out->resize(offset + get_escape_size(size) + 1);
+    out->resize(offset + escape_string(str, size, const_cast<char*>(out->data()) + offset));
 }
 
 void CMySQLConnection::change_charset(const std::string& charset)
@@ -273,6 +276,11 @@ void CMySQLConnection::open()
 
 void CMySQLConnection::close() throw ()
 {
+    // 语句须在连接关闭之前释放
+    for (std::map<std::string, CMySQLStatement*>::iterator iter=_statements.begin(); iter!=_statements.end(); ++iter)
+        delete iter->second;
+    _statements.clear();
+
     if (_mysql_handle != NULL)
     {
         MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
@@ -329,6 +337,42 @@ uint64_t CMySQLConnection::update(const char* format, ...)
     return static_cast<uint64_t>(mysql_affected_rows(mysql_handle));
 }
 
+// LOAD DATA LOCAL INFILE的回调，userdata即CLocalInfileReader
+static int local_infile_init(void** ptr, const char* filename, void* userdata)
+{
+    *ptr = userdata;
+    return 0;
+}
+
+static int local_infile_read(void* ptr, char* buffer, unsigned int size)
+{
+    return static_cast<CLocalInfileReader*>(ptr)->read(buffer, size);
+}
+
+static void local_infile_end(void* ptr)
+{
+}
+
+static int local_infile_error(void* ptr, char* error_msg, unsigned int error_msg_len)
+{
+    snprintf(error_msg, error_msg_len, "%s", static_cast<CLocalInfileReader*>(ptr)->get_error().c_str());
+    return CR_UNKNOWN_ERROR;
+}
+
+uint64_t CMySQLConnection::load_data_local(const std::string& sql, CLocalInfileReader* reader)
+{
+    MOOON_ASSERT(_mysql_handle != NULL);
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+
+    mysql_set_local_infile_handler(mysql_handle, local_infile_init, local_infile_read, local_infile_end, local_infile_error, reader);
+    const int ret = mysql_real_query(mysql_handle, sql.data(), static_cast<unsigned long>(sql.size()));
+    mysql_set_local_infile_default(mysql_handle);
+    if (ret != 0)
+        throw CDBException(sql.c_str(), mysql_error(mysql_handle), mysql_errno(mysql_handle), __FILE__, __LINE__);
+
+    return static_cast<uint64_t>(mysql_affected_rows(mysql_handle));
+}
+
 uint64_t CMySQLConnection::get_insert_id() const
 {
     MOOON_ASSERT(_mysql_handle != NULL);
@@ -545,6 +589,102 @@ void CMySQLConnection::do_query(DBTable& db_table, const char* sql, int sql_leng
     }
 }
 
+// mysql_use_result方式的游标
+class CMySQLCursor: public DBCursor
+{
+public:
+    CMySQLCursor(MYSQL* mysql_handle, MYSQL_RES* result_set, const std::string& null_value)
+        : _mysql_handle(mysql_handle), _result_set(result_set), _null_value(null_value)
+    {
+        _fields.resize(mysql_num_fields(result_set));
+    }
+
+    ~CMySQLCursor()
+    {
+        mysql_free_result(_result_set);
+    }
+
+private:
+    virtual bool fetch()
+    {
+        // 使用mysql_use_result时，mysql_fetch_row返回NULL可能是因为出错
+        MYSQL_ROW row = mysql_fetch_row(_result_set);
+        if (NULL == row)
+        {
+            if (mysql_errno(_mysql_handle) != 0)
+            {
+                throw CDBException(NULL, utils::StringFormatter("%s", mysql_error(_mysql_handle)).c_str(),
+                        mysql_errno(_mysql_handle), __FILE__, __LINE__);
+            }
+
+            return false;
+        }
+
+        // 包含二进制数据的字段，只能以mysql_fetch_lengths取得大小
+        const unsigned long* lengths = mysql_fetch_lengths(_result_set);
+        for (std::vector<DBField>::size_type i=0; i<_fields.size(); ++i)
+        {
+            DBField& field = _fields[i];
+
+            field.is_null = (NULL == row[i]);
+            if (field.is_null)
+            {
+                field.data = _null_value.data();
+                field.size = _null_value.size();
+            }
+            else
+            {
+                field.data = row[i];
+                field.size = static_cast<size_t>(lengths[i]);
+            }
+        }
+
+        return true;
+    }
+
+private:
+    MYSQL* _mysql_handle;
+    MYSQL_RES* _result_set;
+    const std::string _null_value;
+};
+
+DBCursor* CMySQLConnection::do_open_cursor(const char* sql, int sql_length)
+{
+    MOOON_ASSERT(_mysql_handle != NULL);
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+
+    if (mysql_real_query(mysql_handle, sql, (unsigned long)sql_length) != 0)
+    {
+        throw CDBException(sql, utils::StringFormatter("%s", mysql_error(mysql_handle)).c_str(),
+                mysql_errno(mysql_handle), __FILE__, __LINE__);
+    }
+
+    // 和mysql_store_result不同，mysql_use_result不将结果集读到客户端，
+    // 而是在每次mysql_fetch_row时才从服务端读取一行
+    MYSQL_RES* result_set = mysql_use_result(mysql_handle);
+    if (NULL == result_set)
+    {
+        throw CDBException(sql, utils::StringFormatter("%s", mysql_error(mysql_handle)).c_str(),
+                mysql_errno(mysql_handle), __FILE__, __LINE__);
+    }
+
+    return new CMySQLCursor(mysql_handle, result_set, _null_value);
+}
+
+CMySQLStatement* CMySQLConnection::prepare(const std::string& sql)
+{
+    MOOON_ASSERT(_mysql_handle != NULL);
+
+    std::map<std::string, CMySQLStatement*>::iterator iter = _statements.find(sql);
+    if (iter != _statements.end())
+        return iter->second;
+
+    utils::ScopedPtr<CMySQLStatement> stmt(new CMySQLStatement(_mysql_handle, sql));
+    stmt->prepare();
+    _statements.insert(std::make_pair(sql, stmt.get()));
+    return stmt.release();
+}
+
 void CMySQLConnection::do_open()
 {
     MOOON_ASSERT(NULL == _mysql_handle);
@@ -583,6 +723,13 @@ void CMySQLConnection::do_open()
     // 设置自动重连接
     mysql_options(mysql_handle, MYSQL_OPT_RECONNECT, &reconnect);
 
+    if (_local_infile)
+    {
+        // 客户端默认不允许LOAD DATA LOCAL INFILE
+        unsigned int local_infile = 1;
+        mysql_options(mysql_handle, MYSQL_OPT_LOCAL_INFILE, &local_infile);
+    }
+
     if (!_charset.empty())
     {
         // 设置字符集
@@ -613,5 +760,426 @@ void CMySQLConnection::do_open()
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// CMySQLStatement
+
+// MySQL 8.0起MYSQL_BIND中的is_null和error为bool*，之前为my_bool*
+typedef std::remove_pointer<decltype(MYSQL_BIND().is_null)>::type mysql_bool_t;
+
+// 结果字段的初始缓冲区大小，不够时按实际大小扩大
+#define MYSQL_STMT_FIELD_BUFFER_SIZE 256
+
+struct CMySQLStatement::StatementData
+{
+    struct Param
+    {
+        long long int_value; // 也用于存放unsigned long long
+        double double_value;
+        unsigned long length;
+        mysql_bool_t is_null;
+    };
+
+    struct Result
+    {
+        enum_field_types buffer_type; // MYSQL_TYPE_LONGLONG、MYSQL_TYPE_DOUBLE或MYSQL_TYPE_STRING
+        bool is_unsigned;
+        long long int_value;
+        double double_value;
+        std::vector<char> buffer;
+        unsigned long length;
+        mysql_bool_t is_null;
+        mysql_bool_t error;
+        mutable std::string text; // 数值字段以get_field取得时的文本
+    };
+
+    MYSQL_STMT* stmt;
+    MYSQL_RES* metadata; // 查询类语句的结果集元数据，非查询类为NULL
+    std::vector<MYSQL_BIND> param_binds;
+    std::vector<Param> params;
+    std::vector<MYSQL_BIND> result_binds;
+    std::vector<Result> results;
+};
+
+static void throw_stmt_exception(MYSQL_STMT* stmt, const std::string& sql, const char* file, int line)
+{
+    throw CDBException(sql, utils::StringFormatter("%s", mysql_stmt_error(stmt)).c_str(),
+            mysql_stmt_errno(stmt), file, line);
+}
+
+CMySQLStatement::CMySQLStatement(void* mysql_handle, const std::string& sql)
+    : _mysql_handle(mysql_handle), _sql(sql), _data(new StatementData)
+{
+    _data->stmt = NULL;
+    _data->metadata = NULL;
+}
+
+CMySQLStatement::~CMySQLStatement()
+{
+    release();
+    delete _data;
+}
+
+int CMySQLStatement::get_param_number() const
+{
+    return static_cast<int>(_data->params.size());
+}
+
+int CMySQLStatement::get_field_number() const
+{
+    return static_cast<int>(_data->results.size());
+}
+
+void CMySQLStatement::bind_null(int index)
+{
+    check_param_index(index);
+    MYSQL_BIND& bind = _data->param_binds[index];
+    StatementData::Param& param = _data->params[index];
+
+    param.is_null = 1;
+    bind.buffer_type = MYSQL_TYPE_NULL;
+    bind.buffer = NULL;
+    bind.buffer_length = 0;
+    bind.length = NULL;
+}
+
+void CMySQLStatement::bind_int(int index, int64_t value)
+{
+    check_param_index(index);
+    MYSQL_BIND& bind = _data->param_binds[index];
+    StatementData::Param& param = _data->params[index];
+
+    param.int_value = static_cast<long long>(value);
+    param.is_null = 0;
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &param.int_value;
+    bind.is_unsigned = 0;
+    bind.length = NULL;
+}
+
+void CMySQLStatement::bind_uint(int index, uint64_t value)
+{
+    check_param_index(index);
+    MYSQL_BIND& bind = _data->param_binds[index];
+    StatementData::Param& param = _data->params[index];
+
+    param.int_value = static_cast<long long>(value);
+    param.is_null = 0;
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &param.int_value;
+    bind.is_unsigned = 1;
+    bind.length = NULL;
+}
+
+void CMySQLStatement::bind_double(int index, double value)
+{
+    check_param_index(index);
+    MYSQL_BIND& bind = _data->param_binds[index];
+    StatementData::Param& param = _data->params[index];
+
+    param.double_value = value;
+    param.is_null = 0;
+    bind.buffer_type = MYSQL_TYPE_DOUBLE;
+    bind.buffer = &param.double_value;
+    bind.length = NULL;
+}
+
+void CMySQLStatement::bind_string(int index, const char* data, size_t size)
+{
+    check_param_index(index);
+    MYSQL_BIND& bind = _data->param_binds[index];
+    StatementData::Param& param = _data->params[index];
+
+    param.length = static_cast<unsigned long>(size);
+    param.is_null = 0;
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char*>(data);
+    bind.buffer_length = static_cast<unsigned long>(size);
+    bind.length = &param.length;
+}
+
+uint64_t CMySQLStatement::execute()
+{
+    MYSQL_STMT* stmt = _data->stmt;
+
+    // 丢弃上一次未读完的结果集
+    if (_data->metadata != NULL)
+        (void)mysql_stmt_free_result(stmt);
+    if (!_data->param_binds.empty() && (mysql_stmt_bind_param(stmt, &_data->param_binds[0]) != 0))
+        throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+
+    if (mysql_stmt_execute(stmt) != 0)
+    {
+        // 自动重连接后，原连接上预处理的语句在服务端已不存在，重新预处理后再执行一次，
+        // 其它错误（包括连接断开本身）交给调用者处理
+        if (mysql_stmt_errno(stmt) != ER_UNKNOWN_STMT_HANDLER)
+            throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+
+        std::vector<MYSQL_BIND> param_binds = _data->param_binds;
+        std::vector<StatementData::Param> params = _data->params;
+        release();
+        prepare();
+        _data->params = params;
+        _data->param_binds = param_binds;
+        for (std::vector<MYSQL_BIND>::size_type i=0; i<_data->param_binds.size(); ++i)
+        {
+            // 数值参数指向的是自己的存储，须随之更新
+            MYSQL_BIND& bind = _data->param_binds[i];
+            StatementData::Param& param = _data->params[i];
+
+            bind.is_null = &param.is_null;
+            if (MYSQL_TYPE_LONGLONG == bind.buffer_type)
+                bind.buffer = &param.int_value;
+            else if (MYSQL_TYPE_DOUBLE == bind.buffer_type)
+                bind.buffer = &param.double_value;
+            else if (MYSQL_TYPE_STRING == bind.buffer_type)
+                bind.length = &param.length;
+        }
+
+        stmt = _data->stmt;
+        if ((!_data->param_binds.empty() && (mysql_stmt_bind_param(stmt, &_data->param_binds[0]) != 0))
+         || (mysql_stmt_execute(stmt) != 0))
+            throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+    }
+
+    if (_data->metadata != NULL)
+        return 0;
+    return static_cast<uint64_t>(mysql_stmt_affected_rows(stmt));
+}
+
+uint64_t CMySQLStatement::get_insert_id() const
+{
+    return static_cast<uint64_t>(mysql_stmt_insert_id(_data->stmt));
+}
+
+bool CMySQLStatement::fetch()
+{
+    MYSQL_STMT* stmt = _data->stmt;
+    const int ret = mysql_stmt_fetch(stmt);
+
+    if (MYSQL_NO_DATA == ret)
+        return false;
+    if (1 == ret)
+        throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+
+    if (MYSQL_DATA_TRUNCATED == ret)
+    {
+        // 只有字符串类字段会被截断，按实际大小扩大缓冲区后单独再取一次
+        for (std::vector<StatementData::Result>::size_type i=0; i<_data->results.size(); ++i)
+        {
+            StatementData::Result& result = _data->results[i];
+            MYSQL_BIND& bind = _data->result_binds[i];
+
+            if ((MYSQL_TYPE_STRING == result.buffer_type) && !result.is_null && (result.length > result.buffer.size()))
+            {
+                result.buffer.resize(result.length);
+                bind.buffer = &result.buffer[0];
+                bind.buffer_length = static_cast<unsigned long>(result.buffer.size());
+                if (mysql_stmt_fetch_column(stmt, &bind, static_cast<unsigned int>(i), 0) != 0)
+                    throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+            }
+        }
+
+        // 扩大后的缓冲区须重新绑定，下一行才会使用
+        if (mysql_stmt_bind_result(stmt, &_data->result_binds[0]) != 0)
+            throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+    }
+
+    return true;
+}
+
+bool CMySQLStatement::is_null(int index) const
+{
+    return _data->results[index].is_null;
+}
+
+int64_t CMySQLStatement::get_int(int index) const
+{
+    const StatementData::Result& result = _data->results[index];
+
+    if (result.is_null)
+        return 0;
+    if (MYSQL_TYPE_LONGLONG == result.buffer_type)
+        return static_cast<int64_t>(result.int_value);
+    if (MYSQL_TYPE_DOUBLE == result.buffer_type)
+        return static_cast<int64_t>(result.double_value);
+    return static_cast<int64_t>(strtoll(std::string(&result.buffer[0], result.length).c_str(), NULL, 10));
+}
+
+uint64_t CMySQLStatement::get_uint(int index) const
+{
+    const StatementData::Result& result = _data->results[index];
+
+    if (result.is_null)
+        return 0;
+    if (MYSQL_TYPE_LONGLONG == result.buffer_type)
+        return static_cast<uint64_t>(result.int_value);
+    if (MYSQL_TYPE_DOUBLE == result.buffer_type)
+        return static_cast<uint64_t>(result.double_value);
+    return static_cast<uint64_t>(strtoull(std::string(&result.buffer[0], result.length).c_str(), NULL, 10));
+}
+
+double CMySQLStatement::get_double(int index) const
+{
+    const StatementData::Result& result = _data->results[index];
+
+    if (result.is_null)
+        return 0;
+    if (MYSQL_TYPE_DOUBLE == result.buffer_type)
+        return result.double_value;
+    if (MYSQL_TYPE_LONGLONG == result.buffer_type)
+        return result.is_unsigned? static_cast<double>(static_cast<unsigned long long>(result.int_value)): static_cast<double>(result.int_value);
+    return strtod(std::string(&result.buffer[0], result.length).c_str(), NULL);
+}
+
+std::string CMySQLStatement::get_string(int index) const
+{
+    const DBField field = get_field(index);
+    return std::string(field.data, field.size);
+}
+
+DBField CMySQLStatement::get_field(int index) const
+{
+    const StatementData::Result& result = _data->results[index];
+    DBField field;
+
+    field.is_null = result.is_null;
+    if (result.is_null)
+    {
+        field.data = "";
+        field.size = 0;
+    }
+    else if (MYSQL_TYPE_STRING == result.buffer_type)
+    {
+        field.data = &result.buffer[0];
+        field.size = result.length;
+    }
+    else
+    {
+        if (MYSQL_TYPE_DOUBLE == result.buffer_type)
+            result.text = utils::CStringUtils::format_string("%.17g", result.double_value);
+        else if (result.is_unsigned)
+            result.text = utils::CStringUtils::format_string("%llu", static_cast<unsigned long long>(result.int_value));
+        else
+            result.text = utils::CStringUtils::format_string("%lld", result.int_value);
+        field.data = result.text.data();
+        field.size = result.text.size();
+    }
+
+    return field;
+}
+
+void CMySQLStatement::prepare()
+{
+    MYSQL* mysql_handle = static_cast<MYSQL*>(_mysql_handle);
+    MYSQL_STMT* stmt = mysql_stmt_init(mysql_handle);
+    if (NULL == stmt)
+    {
+        throw CDBException(_sql, utils::StringFormatter("%s", mysql_error(mysql_handle)).c_str(),
+                mysql_errno(mysql_handle), __FILE__, __LINE__);
+    }
+
+    _data->stmt = stmt;
+    if (mysql_stmt_prepare(stmt, _sql.data(), static_cast<unsigned long>(_sql.size())) != 0)
+        throw_stmt_exception(stmt, _sql, __FILE__, __LINE__);
+
+    const unsigned long param_number = mysql_stmt_param_count(stmt);
+    _data->params.resize(param_number);
+    _data->param_binds.resize(param_number);
+    for (unsigned long i=0; i<param_number; ++i)
+    {
+        // 未绑定的参数为NULL
+        memset(&_data->params[i], 0, sizeof(StatementData::Param));
+        memset(&_data->param_binds[i], 0, sizeof(MYSQL_BIND));
+        _data->params[i].is_null = 1;
+        _data->param_binds[i].buffer_type = MYSQL_TYPE_NULL;
+        _data->param_binds[i].is_null = &_data->params[i].is_null;
+    }
+
+    // 非查询类语句没有结果集元数据
+    _data->metadata = mysql_stmt_result_metadata(stmt);
+    if (_data->metadata != NULL)
+        bind_result();
+}
+
+void CMySQLStatement::release()
+{
+    if (_data->metadata != NULL)
+    {
+        mysql_free_result(_data->metadata);
+        _data->metadata = NULL;
+    }
+    if (_data->stmt != NULL)
+    {
+        (void)mysql_stmt_close(_data->stmt);
+        _data->stmt = NULL;
+    }
+
+    _data->params.clear();
+    _data->param_binds.clear();
+    _data->results.clear();
+    _data->result_binds.clear();
+}
+
+void CMySQLStatement::bind_result()
+{
+    const unsigned int field_number = mysql_num_fields(_data->metadata);
+    const MYSQL_FIELD* fields = mysql_fetch_fields(_data->metadata);
+
+    _data->results.resize(field_number);
+    _data->result_binds.resize(field_number);
+    for (unsigned int i=0; i<field_number; ++i)
+    {
+        StatementData::Result& result = _data->results[i];
+        MYSQL_BIND& bind = _data->result_binds[i];
+
+        memset(&bind, 0, sizeof(bind));
+        // 整数和浮点数以原生类型取得，其它（包括DECIMAL和日期时间）由客户端库转成字符串
+        switch (fields[i].type)
+        {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_YEAR:
+            result.buffer_type = MYSQL_TYPE_LONGLONG;
+            result.is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+            bind.buffer = &result.int_value;
+            break;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            result.buffer_type = MYSQL_TYPE_DOUBLE;
+            result.is_unsigned = false;
+            bind.buffer = &result.double_value;
+            break;
+        default:
+            result.buffer_type = MYSQL_TYPE_STRING;
+            result.is_unsigned = false;
+            result.buffer.resize(MYSQL_STMT_FIELD_BUFFER_SIZE);
+            bind.buffer = &result.buffer[0];
+            bind.buffer_length = static_cast<unsigned long>(result.buffer.size());
+            break;
+        }
+
+        bind.buffer_type = result.buffer_type;
+        bind.is_unsigned = result.is_unsigned;
+        bind.length = &result.length;
+        bind.is_null = &result.is_null;
+        bind.error = &result.error;
+    }
+
+    if ((field_number > 0) && (mysql_stmt_bind_result(_data->stmt, &_data->result_binds[0]) != 0))
+        throw_stmt_exception(_data->stmt, _sql, __FILE__, __LINE__);
+}
+
+void CMySQLStatement::check_param_index(int index) const
+{
+    if ((index < 0) || (index >= static_cast<int>(_data->params.size())))
+    {
+        throw CDBException(_sql, utils::StringFormatter("invalid parameter index: %d", index).c_str(),
+                DB_ERROR_TOO_MANY_COLS, __FILE__, __LINE__);
+    }
+}
+
 SYS_NAMESPACE_END
 #endif // MOOON_HAVE_MYSQL
@@ -0,0 +1,125 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/parallel.h"
+#include "utils/exception.h"
+#include <exception>
+SYS_NAMESPACE_BEGIN
+
+CParallelContext::CParallelContext(uint32_t chunk_number, CCancellationToken* token)
+    : _chunk_number(chunk_number), _token(token), _next_chunk(0), _references(1), _cancelled(false),
+      _finished_number(0), _failed(false), _errcode(0)
+{
+}
+
+bool CParallelContext::run(CTaskExecutor* executor)
+{
+    if ((executor != NULL) && (_chunk_number > 1))
+    {
+        // 调用者自己也执行块，所以最多提交块数减一个协助任务
+        const uint32_t helper_number = std::min<uint32_t>(executor->get_worker_number(), _chunk_number-1);
+        for (uint32_t i=0; i<helper_number; ++i)
+        {
+            // 先增加引用，协助任务可能在submit返回前就已执行完
+            __atomic_add_fetch(&_references, 1, __ATOMIC_SEQ_CST);
+            if (!executor->submit(utils::bind<void>(&CParallelContext::help, this)))
+            {
+                __atomic_sub_fetch(&_references, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+        }
+    }
+
+    work();
+    LockHelper<CLock> lock_helper(_lock);
+    while (_finished_number < _chunk_number)
+        _event.wait(_lock);
+    if (_failed)
+        THROW_EXCEPTION(_error, _errcode);
+    return !__atomic_load_n(&_cancelled, __ATOMIC_SEQ_CST);
+}
+
+void CParallelContext::release()
+{
+    if (0 == __atomic_sub_fetch(&_references, 1, __ATOMIC_SEQ_CST))
+        delete this;
+}
+
+void CParallelContext::help()
+{
+    work();
+    release();
+}
+
+void CParallelContext::work()
+{
+    while (true)
+    {
+        const uint32_t index = __atomic_fetch_add(&_next_chunk, 1, __ATOMIC_SEQ_CST);
+        if (index >= _chunk_number)
+            break;
+
+        bool failed = false;
+        int errcode = 0;
+        std::string error;
+        if ((_token != NULL) && _token->is_cancelled())
+            __atomic_store_n(&_cancelled, true, __ATOMIC_SEQ_CST);
+        if (!__atomic_load_n(&_cancelled, __ATOMIC_SEQ_CST))
+        {
+            try
+            {
+                run_chunk(index);
+            }
+            catch (utils::CException& ex)
+            {
+                failed = true;
+                errcode = ex.errcode();
+                error = ex.what();
+            }
+            catch (std::exception& ex)
+            {
+                failed = true;
+                errcode = -1;
+                error = ex.what();
+            }
+            catch (...)
+            {
+                // 不能让异常进入执行器，否则该块不会被计为完成，调用者会一直等待
+                failed = true;
+                errcode = -1;
+                error = "unknown exception";
+            }
+        }
+
+        LockHelper<CLock> lock_helper(_lock);
+        if (failed)
+        {
+            __atomic_store_n(&_cancelled, true, __ATOMIC_SEQ_CST);
+            if (!_failed)
+            {
+                _failed = true;
+                _errcode = errcode;
+                _error = error;
+            }
+        }
+        if (++_finished_number == _chunk_number)
+            _event.broadcast();
+    }
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,109 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/parker.h"
+#include "sys/clock.h"
+#include "sys/spin_lock.h"
+#include "sys/utils.h"
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 自旋时每隔多少次检查一次是否超时
+#define PARKER_CLOCK_SPINS 64
+
+CParker::CParker()
+    :_state(0)
+    ,_multi_cpu(CUtils::get_cpu_number() > 1)
+{
+}
+
+bool CParker::park(const CIdleStrategy& strategy, int milliseconds)
+{
+    if (try_consume())
+        return true;
+
+    const uint64_t deadline = (milliseconds < 0)? 0: CClock::get_nanoseconds() + static_cast<uint64_t>(milliseconds) * 1000000;
+    const bool spin_forever = (idle_busy_spin == strategy.type) || (idle_spin_yield == strategy.type);
+    // 单CPU时唤醒方不可能和自旋同时运行，自旋只是白白用完时间片，都改为让出CPU
+    const uint32_t spin_number = ((idle_block == strategy.type) || !_multi_cpu)? 0: strategy.spin_number;
+
+    for (uint32_t i=1; spin_forever || (i<=spin_number); ++i)
+    {
+        // idle_spin_yield自旋完后每次都让出CPU
+        const bool yield = (idle_busy_spin == strategy.type)? !_multi_cpu: (i > spin_number);
+        if (yield)
+            (void)sched_yield();
+        else
+            SPIN_LOCK_PAUSE();
+
+        if ((1 == __atomic_load_n(&_state, __ATOMIC_RELAXED)) && try_consume())
+            return true;
+        if ((deadline != 0) && (0 == i % PARKER_CLOCK_SPINS) && (CClock::get_nanoseconds() >= deadline))
+            return false;
+    }
+
+    if (idle_spin_park == strategy.type)
+    {
+        for (uint32_t i=0; i<strategy.yield_number; ++i)
+        {
+            (void)sched_yield();
+            if (try_consume())
+                return true;
+        }
+    }
+
+    if (0 == deadline)
+        return sleep(-1);
+
+    const uint64_t now = CClock::get_nanoseconds();
+    if (now >= deadline)
+        return try_consume();
+    return sleep(static_cast<int>((deadline - now + 999999) / 1000000));
+}
+
+bool CParker::unpark()
+{
+    // 对方还在自旋时只有这一次原子操作
+    if (__atomic_exchange_n(&_state, 1, __ATOMIC_RELEASE) != -1)
+        return false;
+
+    (void)syscall(SYS_futex, &_state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    return true;
+}
+
+bool CParker::sleep(int milliseconds)
+{
+    // 置为-1后unpark才会有唤醒的系统调用，之前已有许可则不睡眠
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&_state, &expected, -1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        return try_consume();
+
+    struct timespec timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_nsec = (milliseconds % 1000) * 1000000L;
+    (void)syscall(SYS_futex, &_state, FUTEX_WAIT_PRIVATE, -1, (milliseconds < 0)? NULL: &timeout, NULL, 0);
+
+    // 醒来时为1表示被unpark，仍为-1表示超时或被打断
+    return __atomic_exchange_n(&_state, 0, __ATOMIC_ACQUIRE) == 1;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,227 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/perf_counter.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+SYS_NAMESPACE_BEGIN
+
+static const char* sg_perf_event_names[PERF_EVENT_MAX] =
+{
+    "cycles", "instructions", "cache_misses", "branch_misses", "context_switches"
+};
+
+TPerfValues::TPerfValues()
+{
+    clear();
+}
+
+void TPerfValues::clear()
+{
+    memset(values, 0, sizeof(values));
+    available = 0;
+}
+
+void TPerfValues::add(const TPerfValues& other)
+{
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+        values[i] += other.values[i];
+    available |= other.available;
+}
+
+TPerfValues TPerfValues::sub(const TPerfValues& start) const
+{
+    TPerfValues delta;
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+        delta.values[i] = (values[i] >= start.values[i])? values[i] - start.values[i]: 0;
+    delta.available = available;
+    return delta;
+}
+
+std::string TPerfValues::to_json() const
+{
+    std::string json = "{";
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+    {
+        if (!has(static_cast<PerfEvent>(i)))
+            continue;
+
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":%" PRIu64, (json.size() > 1)? ",": "", sg_perf_event_names[i], values[i]);
+        json += buffer;
+    }
+    return json + "}";
+}
+
+std::string TPerfValues::to_string() const
+{
+    std::string str;
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+    {
+        if (!has(static_cast<PerfEvent>(i)))
+            continue;
+
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%s%s=%" PRIu64, str.empty()? "": ", ", sg_perf_event_names[i], values[i]);
+        str += buffer;
+    }
+    if (has(perf_cycles) && has(perf_instructions) && (values[perf_cycles] > 0))
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), ", ipc=%.2f", static_cast<double>(values[perf_instructions]) / values[perf_cycles]);
+        str += buffer;
+    }
+    return str;
+}
+
+const char* TPerfValues::get_name(PerfEvent event)
+{
+    return sg_perf_event_names[event];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CPerfCounters::CPerfCounters()
+    : _leader_fd(-1), _available(0), _number(0)
+{
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+    {
+        _fds[i] = -1;
+        _positions[i] = -1;
+    }
+}
+
+CPerfCounters::~CPerfCounters()
+{
+    close();
+}
+
+static int perf_event_open(uint32_t type, uint64_t config, bool exclude_kernel, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = (-1 == group_fd)? 1: 0; // 组长启动时整组才开始计数
+    attr.exclude_kernel = exclude_kernel? 1: 0;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // pid为0、cpu为-1表示当前线程在任意CPU上的事件
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+bool CPerfCounters::open(bool include_kernel)
+{
+    static const uint32_t types[PERF_EVENT_MAX] =
+    {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE
+    };
+    static const uint64_t configs[PERF_EVENT_MAX] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_CONTEXT_SWITCHES
+    };
+
+    close();
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+    {
+        // 上下文切换发生在核心态，只计用户态时总为0，先尝试计核心态，不允许时退回
+        int fd = -1;
+        if (perf_context_switches == i)
+            fd = perf_event_open(types[i], configs[i], false, _leader_fd);
+        if (-1 == fd)
+            fd = perf_event_open(types[i], configs[i], !include_kernel, _leader_fd);
+        if (-1 == fd)
+            continue; // 不支持的事件，如没有硬件计数器（ENOENT）或不允许（EACCES）
+
+        if (-1 == _leader_fd)
+            _leader_fd = fd;
+        _fds[i] = fd;
+        _positions[i] = _number++;
+        _available |= 1U << i;
+    }
+
+    if ((_leader_fd != -1)
+     && ((-1 == ioctl(_leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP))
+      || (-1 == ioctl(_leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP))))
+    {
+        const int errcode = errno;
+        close();
+        errno = errcode;
+    }
+    return is_open();
+}
+
+void CPerfCounters::close()
+{
+    // 先关闭组员，最后关闭组长
+    for (int i=PERF_EVENT_MAX-1; i>=0; --i)
+    {
+        if ((_fds[i] != -1) && (_fds[i] != _leader_fd))
+            (void)::close(_fds[i]);
+        _fds[i] = -1;
+        _positions[i] = -1;
+    }
+    if (_leader_fd != -1)
+    {
+        (void)::close(_leader_fd);
+        _leader_fd = -1;
+    }
+
+    _available = 0;
+    _number = 0;
+}
+
+bool CPerfCounters::read(perf_values_t* values) const
+{
+    values->clear();
+    if (-1 == _leader_fd)
+        return false;
+
+    // 格式为：组内个数、启用时长、运行时长，之后依次为各计数器的值
+    uint64_t buffer[3 + PERF_EVENT_MAX];
+    const ssize_t bytes = ::read(_leader_fd, buffer, sizeof(buffer));
+    if ((bytes < static_cast<ssize_t>(sizeof(uint64_t) * (3 + _number))) || (buffer[0] != static_cast<uint64_t>(_number)))
+        return false;
+
+    // 被多路复用时，只在运行时长内计数，按比例估算整个启用时长内的值
+    const uint64_t time_enabled = buffer[1];
+    const uint64_t time_running = buffer[2];
+    for (int i=0; i<PERF_EVENT_MAX; ++i)
+    {
+        if (-1 == _positions[i])
+            continue;
+
+        uint64_t value = buffer[3 + _positions[i]];
+        if ((time_running > 0) && (time_running < time_enabled))
+            value = static_cast<uint64_t>(static_cast<double>(value) * time_enabled / time_running);
+        values->values[i] = value;
+    }
+
+    values->available = _available;
+    return true;
+}
+
+SYS_NAMESPACE_END
@@ -30,7 +30,10 @@ CPoolThread::CPoolThreadHelper::CPoolThreadHelper(CPoolThread* pool_thread)
 void CPoolThread::CPoolThreadHelper::run()
 {
 	// wait用于和主线程同步
-	do_millisleep(-1);
+    if (idle_block == _pool_thread->_idle_strategy.type)
+        do_millisleep(-1);
+    else
+        while (!is_stop() && !_pool_thread->_parker.park(_pool_thread->_idle_strategy, -1));
 
     if (!is_stop())
     {
@@ -53,6 +56,8 @@ void CPoolThread::CPoolThreadHelper::before_start()
 
 void CPoolThread::CPoolThreadHelper::before_stop()
 {
+    // 已置停止标识，唤醒可能在CParker上等待的线程
+    (void)_pool_thread->_parker.unpark();
     _pool_thread->before_stop();
 }
 
@@ -66,6 +71,7 @@ void CPoolThread::CPoolThreadHelper::millisleep(int milliseconds)
 
 CPoolThread::CPoolThread()
 	:_index(std::numeric_limits<uint16_t>::max())
+    ,_numa_node(-1)
 {
     _pool_thread_helper = new CPoolThreadHelper(this);
     _pool_thread_helper->inc_refcount(); // 保证生命周期内都是可以用的
@@ -78,7 +84,10 @@ CPoolThread::~CPoolThread()
 
 void CPoolThread::wakeup()
 {
-	_pool_thread_helper->wakeup();
+    if (idle_block == _idle_strategy.type)
+        _pool_thread_helper->wakeup();
+    else
+        (void)_parker.unpark();
 }
 
 void CPoolThread::start()
@@ -101,6 +110,26 @@ size_t CPoolThread::get_stack_size() const
     return _pool_thread_helper->get_stack_size();
 }
 
+void CPoolThread::set_cpu_affinity(const std::vector<int>& cpus)
+{
+    _pool_thread_helper->set_cpu_affinity(cpus);
+}
+
+const std::vector<int>& CPoolThread::get_cpu_affinity() const
+{
+    return _pool_thread_helper->get_cpu_affinity();
+}
+
+void CPoolThread::set_name(const std::string& name)
+{
+    _pool_thread_helper->set_name(name);
+}
+
+const std::string& CPoolThread::get_name() const
+{
+    return _pool_thread_helper->get_name();
+}
+
 uint32_t CPoolThread::get_thread_id() const throw ()
 {
     return _pool_thread_helper->get_thread_id();
@@ -108,7 +137,10 @@ uint32_t CPoolThread::get_thread_id() const throw ()
 
 void CPoolThread::do_millisleep(int milliseconds)
 {
-    _pool_thread_helper->millisleep(milliseconds);
+    if (idle_block == _idle_strategy.type)
+        _pool_thread_helper->millisleep(milliseconds);
+    else if ((_pool_thread_helper->get_thread_id() == CThread::get_current_thread_id()) && !_pool_thread_helper->is_stopped()) // 非本线程调用无效
+        (void)_parker.park(_idle_strategy, milliseconds);
 }
 
 SYS_NAMESPACE_END
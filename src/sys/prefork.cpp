@@ -0,0 +1,400 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/prefork.h"
+#include "sys/clock.h"
+#include "sys/log.h"
+#include "sys/metrics.h"
+#include "sys/utils.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 主进程每轮等待信号的最长毫秒数，也是stop和汇总度量的最大延迟
+#define PREFORK_POLL_MILLISECONDS 100
+
+// 共享内存中一个工作进程的状态，其后紧跟计数器
+struct CPreforkSupervisor::WorkerSlot
+{
+    pid_t pid;
+    uint32_t restart_number;
+    uint64_t counters[1];
+};
+
+// 主进程中一个工作进程的重启状态
+struct CPreforkSupervisor::WorkerState
+{
+    uint64_t start_time;        // 最近一次启动的时间
+    uint64_t restart_time;      // 已退出时，计划重启的时间
+    uint32_t backoff;           // 下一次快速退出后的重启间隔
+    bool running;
+};
+
+CPreforkSupervisor::CPreforkSupervisor(IPreforkWorker* worker, uint16_t worker_number,
+                                       const CThreadPlacement& placement,
+                                       const std::vector<std::string>& counter_names)
+    : _worker(worker), _worker_number((0 == worker_number)? CUtils::get_cpu_number(): worker_number),
+      _placement(placement), _counter_names(counter_names),
+      _restart_milliseconds(100), _max_restart_milliseconds(10000), _stop_milliseconds(10000),
+      _stop(false), _worker_index(-1), _master_pid(0), _slot_size(0), _slots(NULL)
+{
+    if (0 == _worker_number)
+        _worker_number = 1;
+
+    // 计数器个数为0时也保留一个，WorkerSlot::counters至少有一个元素
+    const size_t bytes = offsetof(WorkerSlot, counters) + sizeof(uint64_t) * (counter_names.empty()? 1: counter_names.size());
+    _slot_size = (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    sigemptyset(&_old_sigset);
+}
+
+CPreforkSupervisor::~CPreforkSupervisor()
+{
+    if (_slots != NULL)
+        (void)munmap(_slots, _slot_size * _worker_number);
+}
+
+void CPreforkSupervisor::run()
+{
+    // 信号在run中同步等待，这里先阻塞，否则SIGCHLD等在sigtimedwait之外到达会按默认方式处理
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGCHLD);
+    sigaddset(&sigset, SIGTERM);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGHUP);
+
+    if (NULL == _slots)
+    {
+        void* slots = mmap(NULL, _slot_size * _worker_number, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == slots)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+        _slots = static_cast<char*>(slots);
+    }
+
+    const int errcode = pthread_sigmask(SIG_BLOCK, &sigset, &_old_sigset);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_sigmask");
+
+    _master_pid = getpid();
+    _states.resize(_worker_number);
+    if (_gauges.empty())
+    {
+        CMetricsRegistry* registry = CMetricsRegistry::get_singleton();
+        for (std::vector<std::string>::size_type i=0; i<_counter_names.size(); ++i)
+            _gauges.push_back(registry->get_gauge("prefork." + _counter_names[i]));
+        for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+        {
+            for (std::vector<std::string>::size_type i=0; i<_counter_names.size(); ++i)
+                _gauges.push_back(registry->get_gauge(utils::CStringUtils::format_string("prefork.worker%u.%s", worker_index, _counter_names[i].c_str())));
+        }
+        _gauges.push_back(registry->get_gauge("prefork.restarts"));
+        _gauges.push_back(registry->get_gauge("prefork.workers"));
+    }
+
+    for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+    {
+        _states[worker_index].backoff = _restart_milliseconds;
+        start_worker(worker_index);
+    }
+    MYLOG_INFO("Prefork supervisor %d started %u workers\n", _master_pid, _worker_number);
+
+    while (!_stop)
+    {
+        struct timespec timeout;
+        siginfo_t siginfo;
+        const int milliseconds = get_wait_milliseconds(CClock::get_milliseconds());
+
+        timeout.tv_sec = milliseconds / 1000;
+        timeout.tv_nsec = (milliseconds % 1000) * 1000000L;
+        const int signo = sigtimedwait(&sigset, &siginfo, &timeout);
+        if ((SIGTERM == signo) || (SIGINT == signo))
+        {
+            MYLOG_INFO("Prefork supervisor received %s\n", strsignal(signo));
+            break;
+        }
+        if (SIGHUP == signo)
+            kill_workers(SIGHUP);
+
+        // SIGCHLD是不可靠信号，每轮都回收，不只在收到时
+        reap_workers();
+        restart_workers(CClock::get_milliseconds());
+        publish_metrics();
+    }
+
+    stop_workers();
+    publish_metrics();
+    _stop = false;
+    (void)pthread_sigmask(SIG_SETMASK, &_old_sigset, NULL);
+}
+
+void CPreforkSupervisor::stop()
+{
+    _stop = true;
+}
+
+void CPreforkSupervisor::set_restart_milliseconds(uint32_t milliseconds, uint32_t max_milliseconds)
+{
+    _restart_milliseconds = milliseconds;
+    _max_restart_milliseconds = (max_milliseconds < milliseconds)? milliseconds: max_milliseconds;
+}
+
+void CPreforkSupervisor::add_counter(uint32_t index, uint64_t number)
+{
+    if ((_worker_index != -1) && (index < _counter_names.size()))
+        __atomic_add_fetch(&get_slot(static_cast<uint16_t>(_worker_index))->counters[index], number, __ATOMIC_RELAXED);
+}
+
+uint64_t CPreforkSupervisor::get_counter(uint16_t worker_index, uint32_t index) const
+{
+    if ((NULL == _slots) || (worker_index >= _worker_number) || (index >= _counter_names.size()))
+        return 0;
+    return __atomic_load_n(&get_slot(worker_index)->counters[index], __ATOMIC_RELAXED);
+}
+
+uint64_t CPreforkSupervisor::get_total_counter(uint32_t index) const
+{
+    uint64_t total = 0;
+    for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+        total += get_counter(worker_index, index);
+    return total;
+}
+
+pid_t CPreforkSupervisor::get_worker_pid(uint16_t worker_index) const
+{
+    if ((NULL == _slots) || (worker_index >= _worker_number))
+        return 0;
+    return __atomic_load_n(&get_slot(worker_index)->pid, __ATOMIC_RELAXED);
+}
+
+uint32_t CPreforkSupervisor::get_restart_number(uint16_t worker_index) const
+{
+    if ((NULL == _slots) || (worker_index >= _worker_number))
+        return 0;
+    return __atomic_load_n(&get_slot(worker_index)->restart_number, __ATOMIC_RELAXED);
+}
+
+CPreforkSupervisor::WorkerSlot* CPreforkSupervisor::get_slot(uint16_t worker_index) const
+{
+    return reinterpret_cast<WorkerSlot*>(_slots + _slot_size * worker_index);
+}
+
+void CPreforkSupervisor::start_worker(uint16_t worker_index)
+{
+    WorkerState& state = _states[worker_index];
+
+    // 避免子进程重复输出父进程缓冲中未写出的内容
+    fflush(NULL);
+    const pid_t pid = fork();
+    if (0 == pid)
+    {
+        run_worker(worker_index);
+    }
+    else if (-1 == pid)
+    {
+        // 按重启间隔再试
+        MYLOG_ERROR("Fork worker %u error: %s\n", worker_index, Error::to_string().c_str());
+        state.running = false;
+        state.restart_time = CClock::get_milliseconds() + state.backoff;
+    }
+    else
+    {
+        __atomic_store_n(&get_slot(worker_index)->pid, pid, __ATOMIC_RELAXED);
+        state.running = true;
+        state.start_time = CClock::get_milliseconds();
+        MYLOG_INFO("Worker %u started with pid %d\n", worker_index, pid);
+    }
+}
+
+void CPreforkSupervisor::run_worker(uint16_t worker_index)
+{
+    int exit_code = 1;
+    _worker_index = worker_index;
+
+    // 主进程意外退出时收到SIGTERM，设置之前主进程就已退出的，直接退出
+    if ((-1 == prctl(PR_SET_PDEATHSIG, SIGTERM)) || (getppid() != _master_pid))
+        _exit(1);
+    (void)pthread_sigmask(SIG_SETMASK, &_old_sigset, NULL);
+
+    const std::vector<int> cpus = _placement.get_cpus(worker_index);
+    if (!cpus.empty())
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (std::vector<int>::size_type i=0; i<cpus.size(); ++i)
+            CPU_SET(cpus[i], &cpu_set);
+        if (-1 == sched_setaffinity(0, sizeof(cpu_set), &cpu_set))
+            MYLOG_WARN("Worker %u set affinity error: %s\n", worker_index, Error::to_string().c_str());
+    }
+
+    try
+    {
+        exit_code = _worker->run_worker(worker_index);
+    }
+    catch (utils::CException& ex)
+    {
+        MYLOG_ERROR("Worker %u exception: %s\n", worker_index, ex.str().c_str());
+    }
+
+    // 不执行主进程的atexit和全局对象的析构
+    fflush(NULL);
+    _exit(exit_code);
+}
+
+void CPreforkSupervisor::reap_workers()
+{
+    while (true)
+    {
+        int status;
+        const pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid <= 0)
+            break;
+
+        for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+        {
+            WorkerSlot* slot = get_slot(worker_index);
+            if (slot->pid != pid)
+                continue;
+
+            // 运行时间足够长的立即重启并复位间隔，否则按间隔重启并加倍
+            WorkerState& state = _states[worker_index];
+            const uint64_t now = CClock::get_milliseconds();
+            if (now - state.start_time >= get_min_uptime_milliseconds())
+            {
+                state.backoff = _restart_milliseconds;
+                state.restart_time = now;
+            }
+            else
+            {
+                state.restart_time = now + state.backoff;
+                state.backoff = (state.backoff * 2 > _max_restart_milliseconds)? _max_restart_milliseconds: state.backoff * 2;
+            }
+
+            state.running = false;
+            __atomic_store_n(&slot->pid, 0, __ATOMIC_RELAXED);
+            if (WIFSIGNALED(status))
+                MYLOG_ERROR("Worker %u(%d) killed by %s\n", worker_index, pid, strsignal(WTERMSIG(status)));
+            else
+                MYLOG_ERROR("Worker %u(%d) exited with code %d\n", worker_index, pid, WEXITSTATUS(status));
+            break;
+        }
+    }
+}
+
+void CPreforkSupervisor::restart_workers(uint64_t now)
+{
+    for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+    {
+        WorkerState& state = _states[worker_index];
+        if (!state.running && (state.restart_time <= now))
+        {
+            __atomic_add_fetch(&get_slot(worker_index)->restart_number, 1, __ATOMIC_RELAXED);
+            start_worker(worker_index);
+        }
+    }
+}
+
+void CPreforkSupervisor::stop_workers()
+{
+    kill_workers(SIGTERM);
+
+    const uint64_t deadline = CClock::get_milliseconds() + _stop_milliseconds;
+    while (true)
+    {
+        reap_workers();
+
+        bool running = false;
+        for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+            running = running || _states[worker_index].running;
+        if (!running)
+            break;
+
+        if (CClock::get_milliseconds() >= deadline)
+        {
+            MYLOG_WARN("Workers not exited in %ums, killed\n", _stop_milliseconds);
+            kill_workers(SIGKILL);
+            for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+            {
+                const pid_t pid = get_slot(worker_index)->pid;
+                if (_states[worker_index].running && (pid > 0))
+                    (void)waitpid(pid, NULL, 0);
+                _states[worker_index].running = false;
+                get_slot(worker_index)->pid = 0;
+            }
+            break;
+        }
+
+        CUtils::millisleep(10);
+    }
+}
+
+void CPreforkSupervisor::kill_workers(int signo)
+{
+    for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+    {
+        const pid_t pid = get_slot(worker_index)->pid;
+        if (_states[worker_index].running && (pid > 0))
+            (void)kill(pid, signo);
+    }
+}
+
+void CPreforkSupervisor::publish_metrics()
+{
+    const std::vector<std::string>::size_type counter_number = _counter_names.size();
+    uint64_t restart_number = 0;
+    int64_t running_number = 0;
+
+    for (std::vector<std::string>::size_type i=0; i<counter_number; ++i)
+        _gauges[i]->set(static_cast<int64_t>(get_total_counter(static_cast<uint32_t>(i))));
+    for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+    {
+        for (std::vector<std::string>::size_type i=0; i<counter_number; ++i)
+            _gauges[counter_number * (worker_index + 1) + i]->set(static_cast<int64_t>(get_counter(worker_index, static_cast<uint32_t>(i))));
+        restart_number += get_restart_number(worker_index);
+        if (_states[worker_index].running)
+            ++running_number;
+    }
+
+    _gauges[_gauges.size() - 2]->set(static_cast<int64_t>(restart_number));
+    _gauges[_gauges.size() - 1]->set(running_number);
+}
+
+// 有待重启的工作进程时，等到最早的重启时间
+int CPreforkSupervisor::get_wait_milliseconds(uint64_t now) const
+{
+    uint64_t milliseconds = PREFORK_POLL_MILLISECONDS;
+    for (uint16_t worker_index=0; worker_index<_worker_number; ++worker_index)
+    {
+        const WorkerState& state = _states[worker_index];
+        if (!state.running)
+        {
+            const uint64_t wait = (state.restart_time > now)? state.restart_time - now: 0;
+            if (wait < milliseconds)
+                milliseconds = wait;
+        }
+    }
+    return static_cast<int>(milliseconds);
+}
+
+SYS_NAMESPACE_END
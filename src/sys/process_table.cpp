@@ -0,0 +1,360 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/process_table.h"
+#include "sys/syscall_exception.h"
+#include "sys/utils.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// getdents64返回的目录项
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// 一个扫描线程处理的一段进程，缓冲区在进程间复用
+struct CProcessTable::Worker
+{
+    int proc_fd;
+    uint32_t fields;
+    const CProcessFilter* filter;
+    const int64_t* pids;
+    size_t pid_number;
+    std::vector<process_info_t> processes;
+    std::string stat_buffer;
+    std::string cmdline_buffer;
+};
+
+static bool parse_digits(const char* str, int64_t* number)
+{
+    int64_t value = 0;
+    if ('\0' == *str)
+        return false;
+    for (; *str != '\0'; ++str)
+    {
+        if ((*str < '0') || (*str > '9'))
+            return false;
+        value = value * 10 + (*str - '0');
+    }
+    *number = value;
+    return true;
+}
+
+// 读取/proc下的一个文件（如“123/stat”）到buffer，buffer的容量被复用，文件大小不限
+static bool read_proc_file(int proc_fd, const char* relpath, std::string* buffer)
+{
+    const int fd = openat(proc_fd, relpath, O_RDONLY|O_CLOEXEC);
+    if (-1 == fd)
+        return false;
+
+    size_t size = 0;
+    if (buffer->size() < SIZE_4K)
+        buffer->resize(SIZE_4K);
+    for (;;)
+    {
+        if (size == buffer->size())
+            buffer->resize(buffer->size() * 2);
+
+        const ssize_t n = read(fd, const_cast<char*>(buffer->data())+size, buffer->size()-size);
+        if (n > 0)
+        {
+            size += static_cast<size_t>(n);
+        }
+        else if (0 == n)
+        {
+            break;
+        }
+        else if (errno != EINTR)
+        {
+            close(fd);
+            return false;
+        }
+    }
+
+    close(fd);
+    buffer->resize(size);
+    return true;
+}
+
+// 读取下一个以空格分隔的数字字段
+static int64_t next_field(const char** field)
+{
+    char* end = NULL;
+    const int64_t value = strtoll(*field, &end, 10);
+    *field = end;
+    return value;
+}
+
+// 跳过count个字段
+static void skip_fields(const char** field, int count)
+{
+    for (int i=0; i<count; ++i)
+        (void)next_field(field);
+}
+
+static void scan_processes(CProcessTable::Worker* worker)
+{
+    char relpath[sizeof("18446744073709551615/cmdline")];
+    process_info_t process;
+
+    for (size_t i=0; i<worker->pid_number; ++i)
+    {
+        const int64_t pid = worker->pids[i];
+        snprintf(relpath, sizeof(relpath), "%" PRId64"/stat", pid);
+        if (!read_proc_file(worker->proc_fd, relpath, &worker->stat_buffer))
+            continue; // 已退出
+
+        // 格式：pid (comm) state ppid ...，comm中可能有空格和括号，以最后一个右括号为准
+        const std::string& stat = worker->stat_buffer;
+        const std::string::size_type left = stat.find('(');
+        const std::string::size_type right = stat.rfind(')');
+        if ((std::string::npos == left) || (std::string::npos == right) || (right < left) || (right+2 >= stat.size()))
+            continue;
+
+        const char* name = stat.data() + left + 1;
+        const size_t name_length = right - left - 1;
+        if ((worker->filter != NULL) && !worker->filter->match_name(pid, name, name_length))
+            continue;
+
+        const bool need_cmdline = ((worker->fields & CProcessTable::PROCESS_CMDLINE) != 0) ||
+                                  ((worker->filter != NULL) && worker->filter->need_cmdline());
+        if (need_cmdline)
+        {
+            snprintf(relpath, sizeof(relpath), "%" PRId64"/cmdline", pid);
+            if (!read_proc_file(worker->proc_fd, relpath, &worker->cmdline_buffer))
+                continue;
+            if ((worker->filter != NULL) && worker->filter->need_cmdline() &&
+                !worker->filter->match_cmdline(pid, worker->cmdline_buffer.data(), worker->cmdline_buffer.size()))
+                continue;
+        }
+
+        // 从state开始为第3个字段，stat中的数字字段均以空格分隔，strtoll会跳过前导空格
+        const char* field = stat.c_str() + right + 2;
+        process.pid = pid;
+        process.state = *field++;
+        process.ppid = next_field(&field);       // 4
+        skip_fields(&field, 9);                  // 5~13
+        process.utime = static_cast<uint64_t>(next_field(&field)); // 14
+        process.stime = static_cast<uint64_t>(next_field(&field)); // 15
+        skip_fields(&field, 4);                  // 16~19
+        process.thread_number = static_cast<int32_t>(next_field(&field)); // 20
+        skip_fields(&field, 1);                  // 21
+        process.start_time = static_cast<uint64_t>(next_field(&field));   // 22
+        process.vsize = static_cast<uint64_t>(next_field(&field));        // 23
+        process.rss = next_field(&field);                                 // 24
+        process.name.assign(name, name_length);
+        process.parameters.clear();
+        if ((worker->fields & CProcessTable::PROCESS_CMDLINE) != 0)
+            CProcessTable::split_cmdline(worker->cmdline_buffer.data(), worker->cmdline_buffer.size(), &process.parameters);
+
+        worker->processes.push_back(process);
+    }
+}
+
+static void* scan_thread(void* param)
+{
+    scan_processes(static_cast<CProcessTable::Worker*>(param));
+    return NULL;
+}
+
+static bool pid_less(const process_info_t& lhs, const process_info_t& rhs)
+{
+    return lhs.pid < rhs.pid;
+}
+
+CProcessNameFilter::CProcessNameFilter(const std::string& process_name, bool regex)
+    : _process_name(process_name), _regex(regex)
+{
+    if (_regex)
+    {
+        const int errcode = regcomp(&_preg, process_name.c_str(), REG_EXTENDED|REG_NOSUB);
+        if (errcode != 0)
+        {
+            char errmsg[256];
+            (void)regerror(errcode, &_preg, errmsg, sizeof(errmsg));
+            THROW_EXCEPTION(utils::CStringUtils::format_string("invalid regex[%s]: %s", process_name.c_str(), errmsg), errcode);
+        }
+    }
+}
+
+CProcessNameFilter::~CProcessNameFilter()
+{
+    if (_regex)
+        regfree(&_preg);
+}
+
+bool CProcessNameFilter::match_name(int64_t pid, const char* name, size_t name_length) const
+{
+    if (!_regex)
+        return (name_length == _process_name.size()) && (0 == memcmp(name, _process_name.data(), name_length));
+
+    char name_buffer[SIZE_256];
+    const size_t length = std::min(name_length, sizeof(name_buffer)-1);
+    memcpy(name_buffer, name, length);
+    name_buffer[length] = '\0';
+    return 0 == regexec(&_preg, name_buffer, 0, NULL, 0);
+}
+
+CProcessTable::CProcessTable()
+{
+}
+
+int CProcessTable::scan(uint32_t fields, int threads, const CProcessFilter* filter)
+{
+    std::vector<int64_t> pid_array;
+    list_pids(&pid_array);
+    std::sort(pid_array.begin(), pid_array.end());
+
+    // 自动时每4096个进程一个线程，不超过CPU个数和8
+    if (threads < 1)
+        threads = static_cast<int>(pid_array.size() / 4096) + 1;
+    threads = std::min<int>(threads, std::min<int>(8, std::max<int>(1, CUtils::get_cpu_number())));
+    threads = std::max<int>(1, std::min<int>(threads, static_cast<int>(pid_array.size())));
+
+    const int proc_fd = open("/proc", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (-1 == proc_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
+
+    std::vector<Worker> workers(threads);
+    std::vector<pthread_t> thread_ids(threads);
+    const size_t step = (pid_array.size() + threads - 1) / threads;
+    for (int i=0; i<threads; ++i)
+    {
+        const size_t begin = std::min(pid_array.size(), step * i);
+        const size_t end = std::min(pid_array.size(), begin + step);
+
+        workers[i].proc_fd = proc_fd;
+        workers[i].fields = fields;
+        workers[i].filter = filter;
+        workers[i].pids = pid_array.empty()? NULL: &pid_array[begin];
+        workers[i].pid_number = end - begin;
+    }
+
+    // 第0段在调用线程中扫描，创建线程失败的段也在调用线程中扫描
+    std::vector<bool> started(threads, false);
+    for (int i=1; i<threads; ++i)
+        started[i] = (0 == pthread_create(&thread_ids[i], NULL, scan_thread, &workers[i]));
+    for (int i=0; i<threads; ++i)
+    {
+        if (!started[i])
+            scan_processes(&workers[i]);
+    }
+    for (int i=1; i<threads; ++i)
+    {
+        if (started[i])
+            (void)pthread_join(thread_ids[i], NULL);
+    }
+    close(proc_fd);
+
+    // 各段按pid有序且段间有序，依次合并即有序
+    _processes.clear();
+    for (int i=0; i<threads; ++i)
+        _processes.insert(_processes.end(), workers[i].processes.begin(), workers[i].processes.end());
+    if (!std::is_sorted(_processes.begin(), _processes.end(), pid_less))
+        std::sort(_processes.begin(), _processes.end(), pid_less);
+    return static_cast<int>(_processes.size());
+}
+
+void CProcessTable::get_pids(std::vector<int64_t>* pid_array) const
+{
+    pid_array->reserve(pid_array->size() + _processes.size());
+    for (std::vector<process_info_t>::size_type i=0; i<_processes.size(); ++i)
+        pid_array->push_back(_processes[i].pid);
+}
+
+void CProcessTable::list_pids(std::vector<int64_t>* pid_array)
+{
+    const int fd = open("/proc", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
+
+    // 一次读取多个目录项，30000个进程只需几十次系统调用
+    char buffer[SIZE_32K] __attribute__((aligned(8)));
+    for (;;)
+    {
+        const long n = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (0 == n)
+            break;
+        if (-1 == n)
+        {
+            const int errcode = errno;
+            close(fd);
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "getdents64");
+        }
+
+        for (long offset=0; offset<n;)
+        {
+            const struct linux_dirent64* dirent = reinterpret_cast<const struct linux_dirent64*>(buffer + offset);
+            int64_t pid = 0;
+
+            if (((DT_DIR == dirent->d_type) || (DT_UNKNOWN == dirent->d_type)) && parse_digits(dirent->d_name, &pid))
+                pid_array->push_back(pid);
+            offset += dirent->d_reclen;
+        }
+    }
+
+    close(fd);
+}
+
+bool CProcessTable::read_cmdline(int64_t pid, std::string* cmdline)
+{
+    char relpath[sizeof("18446744073709551615/cmdline")];
+    if (0 == pid)
+        snprintf(relpath, sizeof(relpath), "self/cmdline");
+    else
+        snprintf(relpath, sizeof(relpath), "%" PRId64"/cmdline", pid);
+
+    const int proc_fd = open("/proc", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (-1 == proc_fd)
+        return false;
+
+    const bool read = read_proc_file(proc_fd, relpath, cmdline);
+    close(proc_fd);
+    return read;
+}
+
+void CProcessTable::split_cmdline(const char* cmdline, size_t cmdline_length, std::vector<std::string>* parameters)
+{
+    const char* end = cmdline + cmdline_length;
+    while (cmdline < end)
+    {
+        const char* zero = static_cast<const char*>(memchr(cmdline, '\0', end-cmdline));
+        const char* parameter_end = (NULL == zero)? end: zero;
+
+        if (parameter_end > cmdline)
+            parameters->push_back(std::string(cmdline, parameter_end-cmdline));
+        cmdline = parameter_end + 1;
+    }
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,632 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/profiler.h"
+#include "sys/metrics.h"
+#include "sys/utils.h"
+#include "sys/syscall_exception.h"
+#include <algorithm>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <map>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 每个样本最多保留的帧数
+#define PROFILER_FRAME_MAX 64
+
+// 聚合表的槽数（须为2的幂），以及冲突时最多探测的槽数
+#define PROFILER_SLOT_NUMBER 8192
+#define PROFILER_PROBE_MAX 16
+
+// 一个槽存放一个不同的调用栈及其样本数
+struct ProfileSlot
+{
+    uint32_t state; // 0为空闲，1为正在写入，2为可用
+    uint32_t depth;
+    uint64_t hash;
+    uint64_t count;
+    void* frames[PROFILER_FRAME_MAX]; // 下标0为叶子
+};
+
+static pthread_mutex_t sg_profiler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ProfileSlot* sg_profile_slots = NULL;
+static bool sg_profiler_running = false;
+static bool sg_profiler_handler_installed = false;
+static uint64_t sg_profile_sample_number = 0;
+static uint64_t sg_profile_dropped_number = 0;
+
+static void record_stack(void* const* frames, int depth)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (int i=0; i<depth; ++i)
+        hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ULL;
+
+    for (int probe=0; probe<PROFILER_PROBE_MAX; ++probe)
+    {
+        ProfileSlot* slot = &sg_profile_slots[(hash + probe) & (PROFILER_SLOT_NUMBER - 1)];
+        uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+
+        if (0 == state)
+        {
+            if (__atomic_compare_exchange_n(&slot->state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            {
+                slot->hash = hash;
+                slot->depth = depth;
+                slot->count = 1;
+                for (int i=0; i<depth; ++i)
+                    slot->frames[i] = frames[i];
+                __atomic_store_n(&slot->state, 2, __ATOMIC_RELEASE);
+                return;
+            }
+        }
+
+        // 另一个线程正在写入的槽跳过，同一个栈因此可能占用两个槽，输出时会再合并
+        if ((2 == state) && (slot->hash == hash) && (slot->depth == static_cast<uint32_t>(depth)))
+        {
+            int i = 0;
+            while ((i < depth) && (slot->frames[i] == frames[i]))
+                ++i;
+            if (i == depth)
+            {
+                __atomic_add_fetch(&slot->count, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+    }
+
+    __atomic_add_fetch(&sg_profile_dropped_number, 1, __ATOMIC_RELAXED);
+}
+
+// 得到被信号中断的指令地址
+static void* get_interrupted_pc(void* context)
+{
+    const ucontext_t* uc = static_cast<const ucontext_t*>(context);
+#if defined(__x86_64__)
+    return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+    return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void*>(uc->uc_mcontext.pc);
+#else
+    (void)uc;
+    return NULL;
+#endif
+}
+
+// 信号处理函数中只读写预先分配的表，不分配内存也不加锁
+static void profiler_signal_handler(int signo, siginfo_t* info, void* context)
+{
+    if (!__atomic_load_n(&sg_profiler_running, __ATOMIC_ACQUIRE))
+        return;
+
+    const int saved_errno = errno;
+    void* frames[PROFILER_FRAME_MAX + 4];
+    const int n = backtrace(frames, sizeof(frames)/sizeof(frames[0]));
+
+    // 以被中断的指令为叶子，跳过信号处理函数和信号跳板，找不到时跳过前两帧
+    int first = (n > 2)? 2: n;
+    void* pc = get_interrupted_pc(context);
+    for (int i=0; i<n; ++i)
+    {
+        if (frames[i] == pc)
+        {
+            first = i;
+            break;
+        }
+    }
+
+    const int depth = std::min(n - first, PROFILER_FRAME_MAX);
+    if (depth > 0)
+    {
+        __atomic_add_fetch(&sg_profile_sample_number, 1, __ATOMIC_RELAXED);
+        record_stack(frames+first, depth);
+    }
+    errno = saved_errno;
+}
+
+void CProfiler::start(uint32_t frequency)
+{
+    pthread_mutex_lock(&sg_profiler_mutex);
+
+    try
+    {
+        if (sg_profiler_running)
+            THROW_SYSCALL_EXCEPTION("profiler is running", EBUSY, "start");
+
+        if (NULL == sg_profile_slots)
+        {
+            sg_profile_slots = static_cast<ProfileSlot*>(calloc(PROFILER_SLOT_NUMBER, sizeof(ProfileSlot)));
+            if (NULL == sg_profile_slots)
+                THROW_SYSCALL_EXCEPTION(NULL, ENOMEM, "calloc");
+        }
+        else
+        {
+            memset(sg_profile_slots, 0, PROFILER_SLOT_NUMBER * sizeof(ProfileSlot));
+        }
+        sg_profile_sample_number = 0;
+        sg_profile_dropped_number = 0;
+
+        // backtrace第一次调用时会加载libgcc_s，不能发生在信号处理函数中
+        void* frames[2];
+        (void)backtrace(frames, 2);
+
+        // 信号处理函数安装后不再卸载，停止后延迟到达的SIGPROF因而不会以默认动作结束进程
+        if (!sg_profiler_handler_installed)
+        {
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_sigaction = profiler_signal_handler;
+            sa.sa_flags = SA_RESTART | SA_SIGINFO;
+            sigemptyset(&sa.sa_mask);
+            if (-1 == sigaction(SIGPROF, &sa, NULL))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "sigaction");
+            sg_profiler_handler_installed = true;
+        }
+
+        __atomic_store_n(&sg_profiler_running, true, __ATOMIC_RELEASE);
+        const long interval_microseconds = 1000000 / ((0 == frequency)? 1: std::min(frequency, 1000000U));
+        struct itimerval timer;
+        timer.it_interval.tv_sec = interval_microseconds / 1000000;
+        timer.it_interval.tv_usec = interval_microseconds % 1000000;
+        timer.it_value = timer.it_interval;
+        if (-1 == setitimer(ITIMER_PROF, &timer, NULL))
+        {
+            __atomic_store_n(&sg_profiler_running, false, __ATOMIC_RELEASE);
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "setitimer");
+        }
+    }
+    catch (CSyscallException&)
+    {
+        pthread_mutex_unlock(&sg_profiler_mutex);
+        throw;
+    }
+
+    pthread_mutex_unlock(&sg_profiler_mutex);
+}
+
+void CProfiler::stop()
+{
+    pthread_mutex_lock(&sg_profiler_mutex);
+    if (sg_profiler_running)
+    {
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        (void)setitimer(ITIMER_PROF, &timer, NULL);
+        __atomic_store_n(&sg_profiler_running, false, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&sg_profiler_mutex);
+}
+
+bool CProfiler::is_running()
+{
+    return __atomic_load_n(&sg_profiler_running, __ATOMIC_ACQUIRE);
+}
+
+uint64_t CProfiler::get_sample_number()
+{
+    return __atomic_load_n(&sg_profile_sample_number, __ATOMIC_RELAXED);
+}
+
+uint64_t CProfiler::get_dropped_number()
+{
+    return __atomic_load_n(&sg_profile_dropped_number, __ATOMIC_RELAXED);
+}
+
+// 得到帧的名字，没有符号时为“模块名+偏移”，可再用addr2line转换，
+// 非叶子帧为返回地址，减1后才落在调用者的函数范围内
+static const std::string& get_frame_name(void* address, bool is_leaf, std::map<void*, std::string>* names)
+{
+    void* pc = is_leaf? address: static_cast<char*>(address) - 1;
+    std::map<void*, std::string>::iterator iter = names->find(pc);
+    if (iter != names->end())
+        return iter->second;
+
+    std::string name;
+    Dl_info info;
+    if ((dladdr(pc, &info) != 0) && (info.dli_sname != NULL))
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+        name = (0 == status)? demangled: info.dli_sname;
+        free(demangled);
+    }
+    else if ((dladdr(pc, &info) != 0) && (info.dli_fname != NULL))
+    {
+        const char* slash = strrchr(info.dli_fname, '/');
+        char offset[32];
+        snprintf(offset, sizeof(offset), "+0x%lx", static_cast<unsigned long>(static_cast<char*>(pc) - static_cast<char*>(info.dli_fbase)));
+        name = std::string((NULL == slash)? info.dli_fname: slash+1) + offset;
+    }
+    else
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%p", pc);
+        name = buffer;
+    }
+
+    // 分号是折叠栈的分隔符
+    std::replace(name.begin(), name.end(), ';', ':');
+    return names->insert(std::make_pair(pc, name)).first->second;
+}
+
+std::string CProfiler::get_collapsed()
+{
+    std::map<void*, std::string> names;
+    std::map<std::string, uint64_t> stacks;
+
+    pthread_mutex_lock(&sg_profiler_mutex);
+    for (int i=0; (sg_profile_slots!=NULL) && (i<PROFILER_SLOT_NUMBER); ++i)
+    {
+        const ProfileSlot& slot = sg_profile_slots[i];
+        if (__atomic_load_n(&slot.state, __ATOMIC_ACQUIRE) != 2)
+            continue;
+
+        // 从根到叶子
+        std::string stack;
+        for (int j=static_cast<int>(slot.depth)-1; j>=0; --j)
+        {
+            if (!stack.empty())
+                stack += ';';
+            stack += get_frame_name(slot.frames[j], 0 == j, &names);
+        }
+        stacks[stack] += __atomic_load_n(&slot.count, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&sg_profiler_mutex);
+
+    std::string collapsed;
+    for (std::map<std::string, uint64_t>::const_iterator iter=stacks.begin(); iter!=stacks.end(); ++iter)
+    {
+        char count[32];
+        snprintf(count, sizeof(count), " %" PRIu64"\n", iter->second);
+        collapsed += iter->first + count;
+    }
+    return collapsed;
+}
+
+static void write_file(const std::string& filename, const std::string& content)
+{
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (NULL == fp)
+        THROW_SYSCALL_EXCEPTION(filename, errno, "fopen");
+
+    const bool ok = (fwrite(content.data(), 1, content.size(), fp) == content.size());
+    const int errcode = errno;
+    if ((fclose(fp) != 0) || !ok)
+        THROW_SYSCALL_EXCEPTION(filename, ok? errno: errcode, "fwrite");
+}
+
+void CProfiler::write_collapsed(const std::string& filename)
+{
+    write_file(filename, get_collapsed());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 每个线程的区间数（须为2的幂）
+#define TRACE_RING_SIZE 4096
+
+// 每个线程的环形缓冲区，线程退出后保留，其中的区间仍可导出
+struct TraceRing
+{
+    uint64_t head;  // 已写入的区间总数，只由所属线程写
+    uint64_t begin; // clear时的head，之前的区间不再导出
+    uint32_t thread_id;
+    uint32_t depth;
+    trace_span_t spans[TRACE_RING_SIZE];
+};
+
+bool CTracer::_enabled = false;
+static pthread_mutex_t sg_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<TraceRing*> sg_trace_rings;
+static __thread TraceRing* sg_trace_ring = NULL;
+
+static TraceRing* get_trace_ring()
+{
+    if (NULL == sg_trace_ring)
+    {
+        TraceRing* ring = new TraceRing;
+        ring->head = 0;
+        ring->begin = 0;
+        ring->thread_id = static_cast<uint32_t>(syscall(SYS_gettid));
+        ring->depth = 0;
+
+        pthread_mutex_lock(&sg_trace_mutex);
+        sg_trace_rings.push_back(ring);
+        pthread_mutex_unlock(&sg_trace_mutex);
+        sg_trace_ring = ring;
+    }
+
+    return sg_trace_ring;
+}
+
+void CTracer::enable(bool enabled)
+{
+    __atomic_store_n(&_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+uint32_t CTracer::enter()
+{
+    return get_trace_ring()->depth++;
+}
+
+void CTracer::leave(const char* name, uint64_t start_ns, uint32_t depth)
+{
+    const uint64_t end_ns = CClock::get_nanoseconds();
+    TraceRing* ring = get_trace_ring();
+    const uint64_t head = ring->head;
+    trace_span_t& span = ring->spans[head & (TRACE_RING_SIZE - 1)];
+
+    span.name = name;
+    span.start_ns = start_ns;
+    span.duration_ns = end_ns - start_ns;
+    span.thread_id = ring->thread_id;
+    span.depth = depth;
+    __atomic_store_n(&ring->head, head+1, __ATOMIC_RELEASE);
+    ring->depth = depth;
+}
+
+static bool span_less(const trace_span_t& a, const trace_span_t& b)
+{
+    return a.start_ns < b.start_ns;
+}
+
+void CTracer::get_spans(std::vector<trace_span_t>* spans)
+{
+    spans->clear();
+
+    pthread_mutex_lock(&sg_trace_mutex);
+    for (std::vector<TraceRing*>::size_type i=0; i<sg_trace_rings.size(); ++i)
+    {
+        const TraceRing* ring = sg_trace_rings[i];
+        const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t index = (head > TRACE_RING_SIZE)? head - TRACE_RING_SIZE: 0;
+        if (index < ring->begin)
+            index = ring->begin;
+
+        for (; index<head; ++index)
+            spans->push_back(ring->spans[index & (TRACE_RING_SIZE - 1)]);
+    }
+    pthread_mutex_unlock(&sg_trace_mutex);
+
+    std::sort(spans->begin(), spans->end(), span_less);
+}
+
+void CTracer::clear()
+{
+    pthread_mutex_lock(&sg_trace_mutex);
+    for (std::vector<TraceRing*>::size_type i=0; i<sg_trace_rings.size(); ++i)
+    {
+        TraceRing* ring = sg_trace_rings[i];
+        ring->begin = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&sg_trace_mutex);
+}
+
+void CTracer::write_chrome_trace(const std::string& filename)
+{
+    std::vector<trace_span_t> spans;
+    get_spans(&spans);
+
+    // 区间名为字符串常量，通常不需要转义，仍处理引号和反斜杠
+    const int pid = static_cast<int>(getpid());
+    std::string json = "{\"traceEvents\":[";
+    for (std::vector<trace_span_t>::size_type i=0; i<spans.size(); ++i)
+    {
+        const trace_span_t& span = spans[i];
+        std::string name;
+        for (const char* p=span.name; *p!='\0'; ++p)
+        {
+            if (('"' == *p) || ('\\' == *p))
+                name += '\\';
+            name += *p;
+        }
+
+        char event[160];
+        snprintf(event, sizeof(event), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                 span.start_ns / 1000.0, span.duration_ns / 1000.0, pid, span.thread_id);
+        json += (0 == i)? "\n{\"name\":\"": ",\n{\"name\":\"";
+        json += name;
+        json += event;
+    }
+    json += "\n]}\n";
+
+    write_file(filename, json);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 每把锁最多保留的不同调用栈数，超过的只计数
+#define LOCK_BACKTRACE_MAX 32
+
+class CLockContention
+{
+public:
+    CLockContention(const std::string& name)
+        : _name(name), _contended_number(0), _dropped_number(0)
+    {
+        _wait_histogram = CMetricsRegistry::get_singleton()->get_histogram(std::string("lock.") + name + std::string(".wait_ns"));
+        _contended_counter = CMetricsRegistry::get_singleton()->get_counter(std::string("lock.") + name + std::string(".contended"));
+    }
+
+public:
+    std::string _name;
+    CLatencyHistogram* _wait_histogram;
+    CCounter* _contended_counter;
+    uint64_t _contended_number; // 用于采样，clear时清零
+    uint64_t _dropped_number;   // 因调用栈数超过LOCK_BACKTRACE_MAX而未保留的样本数
+    std::map<std::string, uint64_t> _backtraces; // 调用栈及其次数，由sg_lock_profiler_mutex保护
+};
+
+bool CLockProfiler::_enabled = false;
+static pthread_mutex_t sg_lock_profiler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t sg_lock_sample_rate = 100;
+
+// 不释放，以便其它全局对象析构时仍可使用
+static std::map<std::string, CLockContention*>* get_lock_contentions()
+{
+    static std::map<std::string, CLockContention*>* lock_contentions = new std::map<std::string, CLockContention*>;
+    return lock_contentions;
+}
+
+void CLockProfiler::enable(bool enabled)
+{
+    __atomic_store_n(&_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+void CLockProfiler::set_sample_rate(uint32_t sample_rate)
+{
+    __atomic_store_n(&sg_lock_sample_rate, sample_rate, __ATOMIC_RELAXED);
+}
+
+void CLockProfiler::clear()
+{
+    pthread_mutex_lock(&sg_lock_profiler_mutex);
+    std::map<std::string, CLockContention*>* lock_contentions = get_lock_contentions();
+    for (std::map<std::string, CLockContention*>::iterator iter=lock_contentions->begin(); iter!=lock_contentions->end(); ++iter)
+    {
+        CLockContention* contention = iter->second;
+        CHistogramSnapshot snapshot;
+        contention->_wait_histogram->get_snapshot(&snapshot, true);
+        __atomic_store_n(&contention->_contended_number, 0, __ATOMIC_RELAXED);
+        contention->_dropped_number = 0;
+        contention->_backtraces.clear();
+    }
+    pthread_mutex_unlock(&sg_lock_profiler_mutex);
+}
+
+CLockContention* CLockProfiler::get_contention(const char* name)
+{
+    pthread_mutex_lock(&sg_lock_profiler_mutex);
+    std::map<std::string, CLockContention*>* lock_contentions = get_lock_contentions();
+    std::map<std::string, CLockContention*>::iterator iter = lock_contentions->find(name);
+    CLockContention* contention;
+    if (iter != lock_contentions->end())
+    {
+        contention = iter->second;
+    }
+    else
+    {
+        contention = new CLockContention(name);
+        lock_contentions->insert(std::make_pair(contention->_name, contention));
+    }
+    pthread_mutex_unlock(&sg_lock_profiler_mutex);
+    return contention;
+}
+
+uint64_t CLockProfiler::begin_wait(CLockContention* contention)
+{
+    contention->_contended_counter->inc();
+    const uint64_t number = __atomic_fetch_add(&contention->_contended_number, 1, __ATOMIC_RELAXED);
+    const uint32_t sample_rate = __atomic_load_n(&sg_lock_sample_rate, __ATOMIC_RELAXED);
+
+    // 在等待之前取调用栈，不增加锁的持有时间
+    std::string call_stack;
+    if ((sample_rate > 0) && (0 == number % sample_rate) && CUtils::get_backtrace(call_stack))
+    {
+        pthread_mutex_lock(&sg_lock_profiler_mutex);
+        std::map<std::string, uint64_t>::iterator iter = contention->_backtraces.find(call_stack);
+        if (iter != contention->_backtraces.end())
+            ++iter->second;
+        else if (contention->_backtraces.size() < LOCK_BACKTRACE_MAX)
+            contention->_backtraces.insert(std::make_pair(call_stack, 1));
+        else
+            ++contention->_dropped_number;
+        pthread_mutex_unlock(&sg_lock_profiler_mutex);
+    }
+
+    return CClock::get_nanoseconds();
+}
+
+void CLockProfiler::end_wait(CLockContention* contention, uint64_t start_ns)
+{
+    contention->_wait_histogram->record(CClock::get_nanoseconds() - start_ns);
+}
+
+// 按调用栈的次数从大到小
+static bool greater_backtrace(const std::pair<std::string, uint64_t>& lhs, const std::pair<std::string, uint64_t>& rhs)
+{
+    return lhs.second > rhs.second;
+}
+
+typedef std::pair<CHistogramSnapshot, CLockContention*> lock_result_t;
+
+// 按总等待时间从大到小
+static bool greater_wait(const lock_result_t& lhs, const lock_result_t& rhs)
+{
+    return lhs.first.get_sum() > rhs.first.get_sum();
+}
+
+std::string CLockProfiler::to_string()
+{
+    std::vector<lock_result_t> results;
+    std::string result;
+    char line[512];
+
+    pthread_mutex_lock(&sg_lock_profiler_mutex);
+    std::map<std::string, CLockContention*>* lock_contentions = get_lock_contentions();
+    for (std::map<std::string, CLockContention*>::iterator iter=lock_contentions->begin(); iter!=lock_contentions->end(); ++iter)
+    {
+        results.push_back(lock_result_t(CHistogramSnapshot(), iter->second));
+        iter->second->_wait_histogram->get_snapshot(&results.back().first);
+    }
+    std::sort(results.begin(), results.end(), greater_wait);
+
+    for (std::vector<lock_result_t>::size_type i=0; i<results.size(); ++i)
+    {
+        const CHistogramSnapshot& snapshot = results[i].first;
+        const CLockContention* contention = results[i].second;
+        snprintf(line, sizeof(line), "%s: contended=%" PRIu64", wait_ns total=%" PRIu64" mean=%" PRIu64" p50=%" PRIu64" p99=%" PRIu64" max=%" PRIu64", dropped_backtraces=%" PRIu64"\n",
+                 contention->_name.c_str(), snapshot.get_count(), snapshot.get_sum(), snapshot.get_mean(),
+                 snapshot.get_percentile(50), snapshot.get_percentile(99), snapshot.get_max(), contention->_dropped_number);
+        result += line;
+
+        std::vector<std::pair<std::string, uint64_t> > backtraces(contention->_backtraces.begin(), contention->_backtraces.end());
+        std::sort(backtraces.begin(), backtraces.end(), greater_backtrace);
+        for (std::vector<std::pair<std::string, uint64_t> >::size_type j=0; j<backtraces.size(); ++j)
+        {
+            snprintf(line, sizeof(line), "  %" PRIu64" samples:\n    ", backtraces[j].second);
+            result += line;
+
+            // 每帧一行并缩进
+            const std::string& call_stack = backtraces[j].first;
+            for (std::string::size_type k=0; k<call_stack.size(); ++k)
+            {
+                result += call_stack[k];
+                if ('\n' == call_stack[k])
+                    result += "    ";
+            }
+            result += '\n';
+        }
+    }
+    pthread_mutex_unlock(&sg_lock_profiler_mutex);
+    return result;
+}
+
+void CLockProfiler::write(const std::string& filename)
+{
+    write_file(filename, to_string());
+}
+
+SYS_NAMESPACE_END
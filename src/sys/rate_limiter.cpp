@@ -0,0 +1,199 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/rate_limiter.h"
+#include "utils/exception.h"
+#include <errno.h>
+#include <time.h>
+SYS_NAMESPACE_BEGIN
+
+// 时间的上限，避免极小的速率和极大的数量相乘后溢出
+#define RATE_LIMITER_MAX_NANOSECONDS (UINT64_C(1) << 62)
+
+static void sleep_nanoseconds(uint64_t nanoseconds)
+{
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(nanoseconds / 1000000000);
+    ts.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+    while ((-1 == nanosleep(&ts, &ts)) && (EINTR == errno));
+}
+
+static CCounter* get_limiter_counter(const std::string& metrics_name, const char* suffix)
+{
+    if (metrics_name.empty())
+        return NULL;
+    return CMetricsRegistry::get_singleton()->get_counter("rate_limiter." + metrics_name + suffix);
+}
+
+CTokenBucket::CTokenBucket(uint64_t rate, uint64_t burst, const std::string& metrics_name)
+    : _rate(rate), _burst((0 == burst)? rate: burst),
+      _allowed_counter(get_limiter_counter(metrics_name, ".allowed")),
+      _throttled_counter(get_limiter_counter(metrics_name, ".throttled"))
+{
+    if (0 == rate)
+        THROW_EXCEPTION("rate of token bucket is 0", EINVAL);
+
+    // 开始时桶是满的
+    const uint64_t now = CClock::get_nanoseconds();
+    _burst_nanoseconds = get_cost(_burst);
+    _empty_time = (now > _burst_nanoseconds)? now - _burst_nanoseconds: 0;
+}
+
+bool CTokenBucket::try_acquire(uint64_t number, uint64_t* wait_nanoseconds)
+{
+    return take(number, false, wait_nanoseconds);
+}
+
+uint64_t CTokenBucket::reserve(uint64_t number)
+{
+    uint64_t wait_nanoseconds = 0;
+    (void)take(number, true, &wait_nanoseconds);
+    return wait_nanoseconds;
+}
+
+void CTokenBucket::acquire(uint64_t number)
+{
+    const uint64_t wait_nanoseconds = reserve(number);
+    if (wait_nanoseconds > 0)
+        sleep_nanoseconds(wait_nanoseconds);
+}
+
+uint64_t CTokenBucket::get_available() const
+{
+    const uint64_t now = CClock::get_nanoseconds();
+    const uint64_t empty_time = __atomic_load_n(&_empty_time, __ATOMIC_RELAXED);
+    if (empty_time >= now)
+        return 0;
+    if (now - empty_time >= _burst_nanoseconds)
+        return _burst;
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(now - empty_time) * _rate / 1000000000);
+}
+
+bool CTokenBucket::is_idle(uint64_t now_nanoseconds) const
+{
+    return __atomic_load_n(&_empty_time, __ATOMIC_RELAXED) + _burst_nanoseconds <= now_nanoseconds;
+}
+
+// number个令牌需要的纳秒数，向上取整
+uint64_t CTokenBucket::get_cost(uint64_t number) const
+{
+    const unsigned __int128 cost = (static_cast<unsigned __int128>(number) * 1000000000 + _rate - 1) / _rate;
+    return (cost > RATE_LIMITER_MAX_NANOSECONDS)? RATE_LIMITER_MAX_NANOSECONDS: static_cast<uint64_t>(cost);
+}
+
+// 积攒的令牌不超过burst，即桶为空的时刻不早于now-_burst_nanoseconds
+bool CTokenBucket::take(uint64_t number, bool overdraw, uint64_t* wait_nanoseconds)
+{
+    const uint64_t now = CClock::get_nanoseconds();
+    const uint64_t cost = get_cost(number);
+    const uint64_t lower = (now > _burst_nanoseconds)? now - _burst_nanoseconds: 0;
+    uint64_t empty_time = __atomic_load_n(&_empty_time, __ATOMIC_RELAXED);
+    uint64_t next;
+
+    do
+    {
+        next = ((empty_time > lower)? empty_time: lower) + cost;
+        if ((next > now) && !overdraw)
+            break;
+    } while (!__atomic_compare_exchange_n(&_empty_time, &empty_time, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    const bool allowed = (next <= now);
+    if (wait_nanoseconds != NULL)
+        *wait_nanoseconds = allowed? 0: next - now;
+    if (_allowed_counter != NULL)
+        (allowed? _allowed_counter: _throttled_counter)->inc();
+    return allowed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CGcraLimiter::CGcraLimiter(uint64_t limit, uint32_t period_milliseconds, uint64_t burst, const std::string& metrics_name)
+    : _tat(0),
+      _allowed_counter(get_limiter_counter(metrics_name, ".allowed")),
+      _throttled_counter(get_limiter_counter(metrics_name, ".throttled"))
+{
+    if ((0 == limit) || (0 == period_milliseconds))
+        THROW_EXCEPTION("limit or period of GCRA limiter is 0", EINVAL);
+
+    _emission_interval = static_cast<uint64_t>(period_milliseconds) * 1000000 / limit;
+    if (0 == _emission_interval)
+        _emission_interval = 1;
+    _tolerance = ((0 == burst)? limit: burst) * _emission_interval;
+}
+
+bool CGcraLimiter::try_acquire(uint64_t number, uint64_t* wait_nanoseconds)
+{
+    uint64_t wait = 0;
+    const bool allowed = take(number, &wait);
+
+    if (wait_nanoseconds != NULL)
+        *wait_nanoseconds = wait;
+    if (_allowed_counter != NULL)
+        (allowed? _allowed_counter: _throttled_counter)->inc();
+    return allowed;
+}
+
+void CGcraLimiter::acquire(uint64_t number)
+{
+    uint64_t wait_nanoseconds;
+    if (number * _emission_interval > _tolerance)
+        THROW_EXCEPTION("number exceeds burst of GCRA limiter", EINVAL);
+    if (_allowed_counter != NULL)
+        _allowed_counter->inc();
+    while (!take(number, &wait_nanoseconds))
+        sleep_nanoseconds(wait_nanoseconds);
+}
+
+uint64_t CGcraLimiter::get_remaining() const
+{
+    const uint64_t now = CClock::get_nanoseconds();
+    const uint64_t tat = __atomic_load_n(&_tat, __ATOMIC_RELAXED);
+    const uint64_t used = (tat > now)? tat - now: 0;
+    return (used >= _tolerance)? 0: (_tolerance - used) / _emission_interval;
+}
+
+bool CGcraLimiter::is_idle(uint64_t now_nanoseconds) const
+{
+    return __atomic_load_n(&_tat, __ATOMIC_RELAXED) <= now_nanoseconds;
+}
+
+// 通过后理论到达时间推后number个间隔，推后的结果不能比now超前_tolerance以上
+bool CGcraLimiter::take(uint64_t number, uint64_t* wait_nanoseconds)
+{
+    const uint64_t now = CClock::get_nanoseconds();
+    const unsigned __int128 product = static_cast<unsigned __int128>(number) * _emission_interval;
+    const uint64_t increment = (product > RATE_LIMITER_MAX_NANOSECONDS)? RATE_LIMITER_MAX_NANOSECONDS: static_cast<uint64_t>(product);
+    uint64_t tat = __atomic_load_n(&_tat, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        const uint64_t new_tat = ((tat > now)? tat: now) + increment;
+        const uint64_t allow_time = (new_tat > _tolerance)? new_tat - _tolerance: 0;
+        if (allow_time > now)
+        {
+            *wait_nanoseconds = allow_time - now;
+            return false;
+        }
+        if (__atomic_compare_exchange_n(&_tat, &tat, new_tat, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            *wait_nanoseconds = 0;
+            return true;
+        }
+    }
+}
+
+SYS_NAMESPACE_END
@@ -17,9 +17,26 @@
  * Author: jian yi, eyjian@qq.com
  */
 #include "sys/read_write_lock.h"
+#include "sys/profiler.h"
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
 SYS_NAMESPACE_BEGIN
 
+// 分布式读写锁最多的槽数
+#define RWLOCK_SLOT_MAX 256
+
+// 写者等待读者时，自旋多少次后开始让出CPU
+#define RWLOCK_WRITER_SPINS 1000
+
+// 线程的读者槽序号，线程第一次加读锁时分配，同一线程总是使用同一个槽
+static __thread int sg_rwlock_slot = -1;
+static uint32_t sg_next_rwlock_slot = 0;
+
 CReadWriteLock::CReadWriteLock()
+    : _contention_name(NULL), _contention(NULL)
 {
 	int errcode = pthread_rwlock_init(&_rwlock, NULL);
 	if (errcode != 0)
@@ -36,16 +53,52 @@ CReadWriteLock::~CReadWriteLock() throw ()
 
 void CReadWriteLock::lock_read()
 {
+    // 命名了的锁在分析时先try，取不到时才计时等待
+    uint64_t start_ns = 0;
+    CLockContention* contention = NULL;
+    if ((_contention_name != NULL) && CLockProfiler::is_enabled())
+    {
+        if (try_lock_read())
+            return;
+        contention = get_contention();
+        start_ns = CLockProfiler::begin_wait(contention);
+    }
+
 	int errcode = pthread_rwlock_rdlock(&_rwlock);
 	if (errcode != 0)
 	    THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_rwlock_rdlock");
+    if (contention != NULL)
+        CLockProfiler::end_wait(contention, start_ns);
 }
 
 void CReadWriteLock::lock_write()
 {
+    uint64_t start_ns = 0;
+    CLockContention* contention = NULL;
+    if ((_contention_name != NULL) && CLockProfiler::is_enabled())
+    {
+        if (try_lock_write())
+            return;
+        contention = get_contention();
+        start_ns = CLockProfiler::begin_wait(contention);
+    }
+
 	int errcode = pthread_rwlock_wrlock(&_rwlock);
 	if (errcode != 0)
 	    THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_rwlock_wrlock");
+    if (contention != NULL)
+        CLockProfiler::end_wait(contention, start_ns);
+}
+
+CLockContention* CReadWriteLock::get_contention()
+{
+    CLockContention* contention = __atomic_load_n(&_contention, __ATOMIC_ACQUIRE);
+    if (NULL == contention)
+    {
+        contention = CLockProfiler::get_contention(_contention_name);
+        __atomic_store_n(&_contention, contention, __ATOMIC_RELEASE);
+    }
+    return contention;
 }
 
 void CReadWriteLock::unlock()
@@ -125,4 +178,148 @@ bool CReadWriteLock::timed_lock_write(uint32_t millisecond)
 	THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_rwlock_timedwrlock");
 }
 
+//////////////////////////////////////////////////////////////////////////
+// CDistributedReadWriteLock
+
+CDistributedReadWriteLock::CDistributedReadWriteLock(uint16_t slot_number)
+    :_slots(NULL)
+    ,_slot_mask(0)
+    ,_writer(0)
+    ,_waiter_number(0)
+{
+    uint16_t wanted = (slot_number > 0)? slot_number: CUtils::get_cpu_number();
+    if (wanted > RWLOCK_SLOT_MAX)
+        wanted = RWLOCK_SLOT_MAX;
+
+    uint16_t number = 1;
+    while (number < wanted)
+        number <<= 1;
+
+    void* slots = NULL;
+    int errcode = posix_memalign(&slots, CACHE_LINE_SIZE, sizeof(Slot) * number);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "posix_memalign");
+
+    memset(slots, 0, sizeof(Slot) * number);
+    _slots = static_cast<Slot*>(slots);
+    _slot_mask = number - 1;
+}
+
+CDistributedReadWriteLock::~CDistributedReadWriteLock() throw ()
+{
+    free(_slots);
+}
+
+void CDistributedReadWriteLock::lock_read()
+{
+    Slot* slot = get_slot();
+
+    for (;;)
+    {
+        // 先登记再检查写者，和lock_write中先置写者再检查读者配对
+        __atomic_add_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+        if (0 == __atomic_load_n(&_writer, __ATOMIC_SEQ_CST))
+            break;
+
+        // 有写者，撤销登记并等待写者完成
+        __atomic_sub_fetch(&slot->readers, 1, __ATOMIC_RELEASE);
+        wait_writer();
+    }
+}
+
+void CDistributedReadWriteLock::unlock_read()
+{
+    __atomic_sub_fetch(&get_slot()->readers, 1, __ATOMIC_RELEASE);
+}
+
+void CDistributedReadWriteLock::lock_write()
+{
+    _writer_lock.lock();
+    __atomic_store_n(&_writer, 1, __ATOMIC_SEQ_CST);
+
+    // 读锁的临界区通常很短，先自旋
+    for (uint32_t i=0; has_reader(); ++i)
+    {
+        if (i < RWLOCK_WRITER_SPINS)
+            SPIN_LOCK_PAUSE();
+        else
+            sched_yield();
+    }
+}
+
+void CDistributedReadWriteLock::unlock_write()
+{
+    wake_readers();
+    _writer_lock.unlock();
+}
+
+bool CDistributedReadWriteLock::try_lock_read()
+{
+    Slot* slot = get_slot();
+
+    __atomic_add_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+    if (0 == __atomic_load_n(&_writer, __ATOMIC_SEQ_CST))
+        return true;
+
+    __atomic_sub_fetch(&slot->readers, 1, __ATOMIC_RELEASE);
+    return false;
+}
+
+bool CDistributedReadWriteLock::try_lock_write()
+{
+    if (!_writer_lock.try_lock())
+        return false;
+
+    __atomic_store_n(&_writer, 1, __ATOMIC_SEQ_CST);
+    if (!has_reader())
+        return true;
+
+    // 有读者，放弃并唤醒期间被挡住的读者
+    wake_readers();
+    _writer_lock.unlock();
+    return false;
+}
+
+CDistributedReadWriteLock::Slot* CDistributedReadWriteLock::get_slot()
+{
+    if (-1 == sg_rwlock_slot)
+        sg_rwlock_slot = static_cast<int>(__atomic_fetch_add(&sg_next_rwlock_slot, 1, __ATOMIC_RELAXED) & INT_MAX);
+    return &_slots[sg_rwlock_slot & _slot_mask];
+}
+
+bool CDistributedReadWriteLock::has_reader() const
+{
+    for (uint16_t i=0; i<=_slot_mask; ++i)
+    {
+        if (__atomic_load_n(&_slots[i].readers, __ATOMIC_ACQUIRE) != 0)
+            return true;
+    }
+
+    return false;
+}
+
+void CDistributedReadWriteLock::wait_writer()
+{
+    // 先登记再检查，和wake_readers中先清写者再检查等待者配对，保证不会漏掉唤醒
+    __atomic_add_fetch(&_waiter_number, 1, __ATOMIC_SEQ_CST);
+    while (1 == __atomic_load_n(&_writer, __ATOMIC_SEQ_CST))
+        (void)syscall(SYS_futex, &_writer, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    __atomic_sub_fetch(&_waiter_number, 1, __ATOMIC_SEQ_CST);
+}
+
+void CDistributedReadWriteLock::wake_readers()
+{
+    __atomic_store_n(&_writer, 0, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_waiter_number, __ATOMIC_SEQ_CST) > 0)
+        (void)syscall(SYS_futex, &_writer, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CSeqLock
+
+CSeqLock::CSeqLock()
+    :_seq(0)
+{
+}
+
 SYS_NAMESPACE_END
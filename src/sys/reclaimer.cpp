@@ -0,0 +1,327 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/reclaimer.h"
+#include "sys/syscall_exception.h"
+#include <algorithm>
+SYS_NAMESPACE_BEGIN
+
+// 线程记录的公共部分，记录只增不减，in_use为0的可被其它线程复用
+struct CEpochReclaimer::Record
+{
+    uint64_t local_epoch; // 临界区内为进入时观察到的全局纪元，临界区外为0
+    uint32_t nest;        // 临界区的嵌套层数，只被所属线程访问
+    uint32_t in_use;
+    Record* next;
+    CEpochReclaimer* owner;
+    std::vector<retired_object_t> retired;
+
+    Record(CEpochReclaimer* reclaimer)
+        : local_epoch(0), nest(0), in_use(1), next(NULL), owner(reclaimer)
+    {
+    }
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+CEpochReclaimer::CEpochReclaimer(uint32_t reclaim_threshold)
+    : _global_epoch(1), _records(NULL), _pending_number(0),
+      _reclaim_threshold((0 == reclaim_threshold)? 1: reclaim_threshold)
+{
+    const int errcode = pthread_key_create(&_record_key, on_thread_exit);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_key_create");
+}
+
+CEpochReclaimer::~CEpochReclaimer()
+{
+    // 删除key后，线程退出时不再回调on_thread_exit，没有线程还在使用，全部销毁
+    pthread_key_delete(_record_key);
+    for (Record* record=_records; record!=NULL;)
+    {
+        Record* next = record->next;
+        for (std::vector<retired_object_t>::size_type i=0; i<record->retired.size(); ++i)
+            (*record->retired[i].deleter)(record->retired[i].object);
+        delete record;
+        record = next;
+    }
+}
+
+void CEpochReclaimer::enter()
+{
+    Record* record = get_record();
+    if (0 == record->nest++)
+    {
+        // 全屏障保证之后对共享指针的读不会早于登记，否则写者可能看不到本线程
+        const uint64_t epoch = __atomic_load_n(&_global_epoch, __ATOMIC_RELAXED);
+        __atomic_store_n(&record->local_epoch, epoch, __ATOMIC_SEQ_CST);
+    }
+}
+
+void CEpochReclaimer::leave()
+{
+    Record* record = get_record();
+    if (0 == --record->nest)
+        __atomic_store_n(&record->local_epoch, 0, __ATOMIC_RELEASE);
+}
+
+void CEpochReclaimer::quiescent()
+{
+    Record* record = get_record();
+    if (record->nest > 0)
+    {
+        const uint64_t epoch = __atomic_load_n(&_global_epoch, __ATOMIC_RELAXED);
+        __atomic_store_n(&record->local_epoch, epoch, __ATOMIC_SEQ_CST);
+    }
+
+    (void)try_reclaim();
+}
+
+void CEpochReclaimer::retire(void* object, reclaim_deleter_t deleter)
+{
+    Record* record = get_record();
+    retired_object_t retired_object;
+
+    // 对象已被摘下，这之后进入临界区的读者不可能再取得它
+    retired_object.object = object;
+    retired_object.deleter = deleter;
+    retired_object.epoch = __atomic_load_n(&_global_epoch, __ATOMIC_SEQ_CST);
+    record->retired.push_back(retired_object);
+    __atomic_add_fetch(&_pending_number, 1, __ATOMIC_RELAXED);
+
+    if (record->retired.size() >= _reclaim_threshold)
+        (void)try_reclaim();
+}
+
+uint32_t CEpochReclaimer::try_reclaim()
+{
+    Record* record = get_record();
+    (void)try_advance(__atomic_load_n(&_global_epoch, __ATOMIC_ACQUIRE));
+    return reclaim(record);
+}
+
+CEpochReclaimer::Record* CEpochReclaimer::get_record()
+{
+    Record* record = static_cast<Record*>(pthread_getspecific(_record_key));
+    if (record != NULL)
+        return record;
+
+    // 先复用已退出线程的记录
+    for (record=__atomic_load_n(&_records, __ATOMIC_ACQUIRE); record!=NULL; record=record->next)
+    {
+        uint32_t in_use = 0;
+        if (__atomic_compare_exchange_n(&record->in_use, &in_use, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if (NULL == record)
+    {
+        record = new Record(this);
+        record->next = __atomic_load_n(&_records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&_records, &record->next, record, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    pthread_setspecific(_record_key, record);
+    return record;
+}
+
+// 所有在临界区中的线程都已观察到epoch时，才能推进到epoch+1
+bool CEpochReclaimer::try_advance(uint64_t epoch)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (Record* record=__atomic_load_n(&_records, __ATOMIC_ACQUIRE); record!=NULL; record=record->next)
+    {
+        const uint64_t local_epoch = __atomic_load_n(&record->local_epoch, __ATOMIC_ACQUIRE);
+        if ((local_epoch != 0) && (local_epoch != epoch))
+            return false;
+    }
+
+    return __atomic_compare_exchange_n(&_global_epoch, &epoch, epoch+1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+uint32_t CEpochReclaimer::reclaim(Record* record)
+{
+    const uint64_t epoch = __atomic_load_n(&_global_epoch, __ATOMIC_ACQUIRE);
+    std::vector<retired_object_t>& retired = record->retired;
+    std::vector<retired_object_t>::size_type kept = 0;
+
+    for (std::vector<retired_object_t>::size_type i=0; i<retired.size(); ++i)
+    {
+        if (retired[i].epoch + 2 <= epoch)
+            (*retired[i].deleter)(retired[i].object);
+        else
+            retired[kept++] = retired[i];
+    }
+
+    const uint32_t number = static_cast<uint32_t>(retired.size() - kept);
+    retired.resize(kept);
+    if (number > 0)
+        __atomic_sub_fetch(&_pending_number, number, __ATOMIC_RELAXED);
+    return number;
+}
+
+void CEpochReclaimer::on_thread_exit(void* param)
+{
+    Record* record = static_cast<Record*>(param);
+    CEpochReclaimer* reclaimer = record->owner;
+
+    record->nest = 0;
+    __atomic_store_n(&record->local_epoch, 0, __ATOMIC_RELEASE);
+    (void)reclaimer->try_advance(__atomic_load_n(&reclaimer->_global_epoch, __ATOMIC_ACQUIRE));
+    (void)reclaimer->reclaim(record);
+    __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct CHazardPointers::Record
+{
+    void** slots;
+    uint32_t in_use;
+    Record* next;
+    CHazardPointers* owner;
+    std::vector<retired_object_t> retired;
+
+    Record(CHazardPointers* hazard_pointers, uint32_t slot_number)
+        : slots(new void*[slot_number]), in_use(1), next(NULL), owner(hazard_pointers)
+    {
+        for (uint32_t i=0; i<slot_number; ++i)
+            slots[i] = NULL;
+    }
+
+    ~Record()
+    {
+        delete []slots;
+    }
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+CHazardPointers::CHazardPointers(uint32_t slot_number)
+    : _slot_number((0 == slot_number)? 1: slot_number), _records(NULL), _record_number(0)
+{
+    const int errcode = pthread_key_create(&_record_key, on_thread_exit);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_key_create");
+}
+
+CHazardPointers::~CHazardPointers()
+{
+    pthread_key_delete(_record_key);
+    for (Record* record=_records; record!=NULL;)
+    {
+        Record* next = record->next;
+        for (std::vector<retired_object_t>::size_type i=0; i<record->retired.size(); ++i)
+            (*record->retired[i].deleter)(record->retired[i].object);
+        delete record;
+        record = next;
+    }
+}
+
+void CHazardPointers::clear(uint32_t slot)
+{
+    __atomic_store_n(get_slot(slot), static_cast<void*>(NULL), __ATOMIC_RELEASE);
+}
+
+void CHazardPointers::retire(void* object, reclaim_deleter_t deleter)
+{
+    Record* record = get_record();
+    retired_object_t retired_object;
+    retired_object.object = object;
+    retired_object.deleter = deleter;
+    retired_object.epoch = 0;
+    record->retired.push_back(retired_object);
+
+    // 阈值和槽位总数成正比，每次扫描至少可回收一半，扫描的开销被均摊
+    const uint32_t threshold = 2 * _slot_number * __atomic_load_n(&_record_number, __ATOMIC_RELAXED);
+    if (record->retired.size() >= std::max<uint32_t>(threshold, 16))
+        (void)reclaim(record);
+}
+
+uint32_t CHazardPointers::scan()
+{
+    return reclaim(get_record());
+}
+
+CHazardPointers::Record* CHazardPointers::get_record()
+{
+    Record* record = static_cast<Record*>(pthread_getspecific(_record_key));
+    if (record != NULL)
+        return record;
+
+    for (record=__atomic_load_n(&_records, __ATOMIC_ACQUIRE); record!=NULL; record=record->next)
+    {
+        uint32_t in_use = 0;
+        if (__atomic_compare_exchange_n(&record->in_use, &in_use, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if (NULL == record)
+    {
+        record = new Record(this, _slot_number);
+        __atomic_add_fetch(&_record_number, 1, __ATOMIC_RELAXED);
+        record->next = __atomic_load_n(&_records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&_records, &record->next, record, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    pthread_setspecific(_record_key, record);
+    return record;
+}
+
+void** CHazardPointers::get_slot(uint32_t slot)
+{
+    MOOON_ASSERT(slot < _slot_number);
+    return &get_record()->slots[slot];
+}
+
+// 销毁不在任何线程槽位中的对象
+uint32_t CHazardPointers::reclaim(Record* record)
+{
+    std::vector<void*> hazards;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (Record* other=__atomic_load_n(&_records, __ATOMIC_ACQUIRE); other!=NULL; other=other->next)
+    {
+        for (uint32_t i=0; i<_slot_number; ++i)
+        {
+            void* hazard = __atomic_load_n(&other->slots[i], __ATOMIC_ACQUIRE);
+            if (hazard != NULL)
+                hazards.push_back(hazard);
+        }
+    }
+    std::sort(hazards.begin(), hazards.end());
+
+    std::vector<retired_object_t>& retired = record->retired;
+    std::vector<retired_object_t>::size_type kept = 0;
+    for (std::vector<retired_object_t>::size_type i=0; i<retired.size(); ++i)
+    {
+        if (std::binary_search(hazards.begin(), hazards.end(), retired[i].object))
+            retired[kept++] = retired[i];
+        else
+            (*retired[i].deleter)(retired[i].object);
+    }
+
+    const uint32_t number = static_cast<uint32_t>(retired.size() - kept);
+    retired.resize(kept);
+    return number;
+}
+
+void CHazardPointers::on_thread_exit(void* param)
+{
+    Record* record = static_cast<Record*>(param);
+    CHazardPointers* hazard_pointers = record->owner;
+
+    for (uint32_t i=0; i<hazard_pointers->_slot_number; ++i)
+        __atomic_store_n(&record->slots[i], static_cast<void*>(NULL), __ATOMIC_RELEASE);
+    (void)hazard_pointers->reclaim(record);
+    __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+SYS_NAMESPACE_END
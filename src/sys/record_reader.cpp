@@ -0,0 +1,450 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/record_reader.h"
+#include "sys/syscall_exception.h"
+#include "sys/utils.h"
+#include "utils/exception.h"
+#include "utils/string_simd.h"
+#include "utils/string_utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 从pos开始找第一个不在引号中的换行符，in_quote为pos处是否在引号中，找不到时返回size
+static size_t find_newline(const char* data, size_t size, size_t pos, char quote, bool in_quote)
+{
+    if ('\0' == quote)
+    {
+        const char* newline = static_cast<const char*>(memchr(data+pos, '\n', size-pos));
+        return (NULL == newline)? size: static_cast<size_t>(newline-data);
+    }
+
+    while (pos < size)
+    {
+        // 在引号中时只需找下一个引号
+        if (in_quote)
+        {
+            const char* found = static_cast<const char*>(memchr(data+pos, quote, size-pos));
+            if (NULL == found)
+                break;
+            pos = static_cast<size_t>(found-data) + 1;
+            in_quote = false;
+        }
+        else
+        {
+            pos += utils::CStringSimd::find_first_of(data+pos, size-pos, '\n', quote);
+            if ((pos >= size) || ('\n' == data[pos]))
+                return pos;
+            ++pos;
+            in_quote = true;
+        }
+    }
+    return size;
+}
+
+// 去掉结尾的'\r'
+static size_t trim_cr(const char* data, size_t begin, size_t end)
+{
+    return ((end > begin) && ('\r' == data[end-1]))? end-1: end;
+}
+
+CRecordReader::CRecordReader(char delimiter, char quote)
+    : _delimiter(delimiter), _quote(quote), _data(NULL), _size(0), _offset(0), _record_number(0), _mmap(NULL), _fd(-1), _eof(true)
+{
+}
+
+CRecordReader::~CRecordReader()
+{
+    try
+    {
+        close();
+    }
+    catch (CSyscallException&)
+    {
+    }
+}
+
+void CRecordReader::open(const std::string& filename)
+{
+    struct stat st;
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", filename.c_str(), strerror(errno)), errno, "open");
+
+    close();
+    try
+    {
+        if (-1 == fstat(fd, &st))
+            THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("stat %s failed: %s", filename.c_str(), strerror(errno)), errno, "fstat");
+
+        // 空文件不能映射
+        if (st.st_size > 0)
+        {
+            _mmap = CMMap::map_read(fd);
+            _data = static_cast<const char*>(_mmap->addr);
+            _size = _mmap->len;
+            (void)madvise(_mmap->addr, _mmap->len, MADV_SEQUENTIAL);
+        }
+        ::close(fd); // 关闭后映射仍然有效
+    }
+    catch (CSyscallException&)
+    {
+        ::close(fd);
+        throw;
+    }
+}
+
+void CRecordReader::open(int fd, size_t buffer_size)
+{
+    close();
+    _fd = fd;
+    _eof = false;
+    _buffer.resize((buffer_size > 0)? buffer_size: SIZE_4K);
+    _data = &_buffer[0];
+}
+
+void CRecordReader::attach(const char* data, size_t size)
+{
+    close();
+    _data = data;
+    _size = size;
+}
+
+void CRecordReader::close()
+{
+    mmap_t* ptr = _mmap;
+
+    _data = NULL;
+    _size = 0;
+    _offset = 0;
+    _record_number = 0;
+    _mmap = NULL;
+    _fd = -1;
+    _eof = true;
+    std::vector<char>().swap(_buffer);
+    if (ptr != NULL)
+        CMMap::unmap(ptr);
+}
+
+bool CRecordReader::find_record(size_t* record_end, size_t* next_offset) const
+{
+    const size_t newline = find_newline(_data, _size, _offset, _quote, false);
+    if (newline >= _size)
+        return false;
+
+    *record_end = trim_cr(_data, _offset, newline);
+    *next_offset = newline + 1;
+    return true;
+}
+
+bool CRecordReader::fill()
+{
+    if (_eof)
+        return false;
+
+    // 移走已读取的，放不下一条记录时扩大缓冲区
+    if (_offset > 0)
+    {
+        memmove(&_buffer[0], &_buffer[_offset], _size-_offset);
+        _size -= _offset;
+        _offset = 0;
+    }
+    if (_size == _buffer.size())
+    {
+        _buffer.resize(_buffer.size() * 2);
+        _data = &_buffer[0];
+    }
+
+    for (;;)
+    {
+        const ssize_t n = read(_fd, &_buffer[_size], _buffer.size()-_size);
+        if (n > 0)
+        {
+            _size += static_cast<size_t>(n);
+            return true;
+        }
+        if (0 == n)
+        {
+            _eof = true;
+            return false;
+        }
+        if (errno != EINTR)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
+    }
+}
+
+bool CRecordReader::next(std::string_view* record)
+{
+    size_t record_end = 0;
+    size_t next_offset = 0;
+
+    while (!find_record(&record_end, &next_offset))
+    {
+        if (fill())
+            continue;
+
+        // 最后一条记录没有换行符
+        if (_offset >= _size)
+            return false;
+        record_end = trim_cr(_data, _offset, _size);
+        next_offset = _size;
+        break;
+    }
+
+    *record = std::string_view(_data+_offset, record_end-_offset);
+    _offset = next_offset;
+    ++_record_number;
+    return true;
+}
+
+bool CRecordReader::next(std::vector<std::string_view>* fields)
+{
+    std::string_view record;
+    if (!next(&record))
+        return false;
+
+    (void)split(record, _delimiter, _quote, fields);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct CRecordReader::Chunk
+{
+    const char* data;
+    size_t size;
+    char quote;
+    CRecordHandler* handler;
+    int index;
+    bool last;
+    bool counting;    // 为true时只统计引号个数
+
+    size_t raw_begin; // 等分处
+    size_t raw_end;
+    bool in_quote;    // raw_begin处是否在引号中
+    bool in_quote_end;
+    size_t quote_number;
+    uint64_t record_number;
+};
+
+// 块的开始为等分处之后第一个记录的开始，块0从头开始
+static void run_chunk(CRecordReader::Chunk* chunk)
+{
+    if (chunk->counting)
+    {
+        chunk->quote_number = utils::CStringSimd::count_char(chunk->data+chunk->raw_begin, chunk->raw_end-chunk->raw_begin, chunk->quote);
+        return;
+    }
+
+    size_t begin = chunk->raw_begin;
+    size_t end = chunk->size;
+    if (chunk->index > 0)
+    {
+        begin = find_newline(chunk->data, chunk->size, begin, chunk->quote, chunk->in_quote);
+        if (begin < chunk->size)
+            ++begin;
+    }
+    if (!chunk->last)
+    {
+        end = find_newline(chunk->data, chunk->size, chunk->raw_end, chunk->quote, chunk->in_quote_end);
+        if (end < chunk->size)
+            ++end;
+    }
+
+    while (begin < end)
+    {
+        size_t newline = find_newline(chunk->data, end, begin, chunk->quote, false);
+        const size_t record_end = trim_cr(chunk->data, begin, newline);
+
+        ++chunk->record_number;
+        if (!chunk->handler->handle(chunk->index, std::string_view(chunk->data+begin, record_end-begin)))
+            break;
+        begin = newline + 1;
+    }
+}
+
+static void* chunk_thread(void* param)
+{
+    run_chunk(static_cast<CRecordReader::Chunk*>(param));
+    return NULL;
+}
+
+// 块0和创建线程失败的块在调用者线程中处理
+static void run_chunks(std::vector<CRecordReader::Chunk>* chunks)
+{
+    std::vector<pthread_t> threads(chunks->size());
+    std::vector<bool> started(chunks->size(), false);
+
+    for (std::vector<CRecordReader::Chunk>::size_type i=1; i<chunks->size(); ++i)
+        started[i] = (0 == pthread_create(&threads[i], NULL, chunk_thread, &(*chunks)[i]));
+    for (std::vector<CRecordReader::Chunk>::size_type i=0; i<chunks->size(); ++i)
+    {
+        if (!started[i])
+            run_chunk(&(*chunks)[i]);
+    }
+    for (std::vector<CRecordReader::Chunk>::size_type i=1; i<chunks->size(); ++i)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+}
+
+uint64_t CRecordReader::parallel_read(CRecordHandler* handler, int thread_number)
+{
+    if (_fd != -1)
+        THROW_EXCEPTION("parallel_read not supported for fd", EINVAL);
+
+    // 从当前位置开始，当前位置总是记录的开始
+    const char* data = _data + _offset;
+    const size_t size = _size - _offset;
+    uint64_t record_number = 0;
+    if (0 == size)
+        return 0;
+
+    if (thread_number <= 0)
+    {
+        const int cpu_number = static_cast<int>(CUtils::get_cpu_number());
+        thread_number = static_cast<int>(size / (64 * SIZE_1M)) + 1;
+        if (thread_number > cpu_number)
+            thread_number = cpu_number;
+    }
+    if (static_cast<size_t>(thread_number) > size)
+        thread_number = static_cast<int>(size);
+    if (thread_number < 1)
+        thread_number = 1;
+
+    std::vector<Chunk> chunks(thread_number);
+    for (int i=0; i<thread_number; ++i)
+    {
+        Chunk& chunk = chunks[i];
+        chunk.data = data;
+        chunk.size = size;
+        chunk.quote = _quote;
+        chunk.handler = handler;
+        chunk.index = i;
+        chunk.last = (i == thread_number-1);
+        chunk.counting = ('\0' != _quote);
+        chunk.raw_begin = size / thread_number * i;
+        chunk.raw_end = chunk.last? size: size / thread_number * (i+1);
+        chunk.in_quote = false;
+        chunk.in_quote_end = false;
+        chunk.quote_number = 0;
+        chunk.record_number = 0;
+    }
+
+    // 由之前各块中的引号个数的奇偶确定等分处是否在引号中
+    if (_quote != '\0')
+    {
+        size_t quote_number = 0;
+
+        run_chunks(&chunks);
+        for (int i=0; i<thread_number; ++i)
+        {
+            chunks[i].in_quote = (1 == quote_number % 2);
+            quote_number += chunks[i].quote_number;
+            chunks[i].in_quote_end = (1 == quote_number % 2);
+            chunks[i].counting = false;
+        }
+    }
+
+    run_chunks(&chunks);
+    for (int i=0; i<thread_number; ++i)
+        record_number += chunks[i].record_number;
+
+    _offset = _size;
+    _record_number += record_number;
+    return record_number;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int CRecordReader::split(std::string_view record, char delimiter, char quote, std::vector<std::string_view>* fields)
+{
+    const char* data = record.data();
+    const size_t size = record.size();
+    size_t pos = 0;
+
+    fields->clear();
+    if (0 == size)
+        return 0;
+
+    for (;;)
+    {
+        size_t field_begin = pos;
+        size_t field_end = size;
+
+        if (('\0' != quote) && (pos < size) && (quote == data[pos]))
+        {
+            // 找结束的引号，跳过连续两个引号，结束的引号到分隔符之间的内容被忽略，没有结束的引号时到结尾
+            size_t i = pos + 1;
+            field_begin = i;
+            pos = size;
+            while (i < size)
+            {
+                const char* found = static_cast<const char*>(memchr(data+i, quote, size-i));
+                if (NULL == found)
+                    break;
+
+                i = static_cast<size_t>(found-data);
+                if ((i+1 < size) && (quote == data[i+1]))
+                {
+                    i += 2;
+                    continue;
+                }
+
+                field_end = i;
+                pos = i + 1;
+                break;
+            }
+        }
+
+        const char* sep = static_cast<const char*>(memchr(data+pos, delimiter, size-pos));
+        if (NULL == sep)
+        {
+            fields->push_back(std::string_view(data+field_begin, field_end-field_begin));
+            break;
+        }
+
+        if (field_end == size)
+            field_end = static_cast<size_t>(sep-data);
+        fields->push_back(std::string_view(data+field_begin, field_end-field_begin));
+        pos = static_cast<size_t>(sep-data) + 1;
+    }
+
+    return static_cast<int>(fields->size());
+}
+
+std::string CRecordReader::unquote(std::string_view field, char quote)
+{
+    std::string result;
+    result.reserve(field.size());
+
+    for (size_t i=0; i<field.size(); ++i)
+    {
+        result.push_back(field[i]);
+        if ((quote == field[i]) && (i+1 < field.size()) && (quote == field[i+1]))
+            ++i;
+    }
+    return result;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,177 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/ref_countable.h"
+#include <pthread.h>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+// 拥有线程的待合并队列，不释放，线程退出后仍可被交出者访问，
+// 也因此不同线程的队列地址总是不同的，可用来识别拥有线程
+struct CBiasedRefCount::Queue
+{
+    pthread_mutex_t lock;
+    bool exited;                            // 拥有线程已退出
+    uint32_t number;                        // objects的个数，用于无锁判断是否有待合并的对象
+    std::vector<CBiasedRefCount*> objects;
+};
+
+__thread CBiasedRefCount::Queue* CBiasedRefCount::_thread_queue = NULL;
+
+static pthread_once_t sg_queue_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sg_queue_key;
+
+static void on_thread_exit(void* param)
+{
+    CBiasedRefCount::Queue* queue = static_cast<CBiasedRefCount::Queue*>(param);
+
+    // 线程私有变量此时仍可访问，先处理已交来的对象，之后交来的由交出者直接合并
+    (void)CBiasedRefCount::merge_pending();
+    pthread_mutex_lock(&queue->lock);
+    queue->exited = true;
+    pthread_mutex_unlock(&queue->lock);
+    (void)CBiasedRefCount::merge_pending();
+}
+
+static void create_queue_key()
+{
+    (void)pthread_key_create(&sg_queue_key, on_thread_exit);
+}
+
+CBiasedRefCount::CBiasedRefCount()
+    : _queue(get_queue()), _biased(0), _merged(false), _shared(0), _object(NULL), _deleter(NULL)
+{
+}
+
+int CBiasedRefCount::get() const
+{
+    const int64_t shared = __atomic_load_n(&_shared, __ATOMIC_ACQUIRE);
+    const int64_t biased = __atomic_load_n(&_merged, __ATOMIC_RELAXED)? 0: __atomic_load_n(&_biased, __ATOMIC_RELAXED);
+    return static_cast<int>(biased + (shared >> 2));
+}
+
+uint32_t CBiasedRefCount::merge_pending()
+{
+    Queue* queue = _thread_queue;
+    if ((NULL == queue) || (0 == __atomic_load_n(&queue->number, __ATOMIC_ACQUIRE)))
+        return 0;
+
+    std::vector<CBiasedRefCount*> objects;
+    pthread_mutex_lock(&queue->lock);
+    objects.swap(queue->objects);
+    __atomic_store_n(&queue->number, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&queue->lock);
+
+    uint32_t destroyed = 0;
+    for (std::vector<CBiasedRefCount*>::size_type i=0; i<objects.size(); ++i)
+    {
+        CBiasedRefCount* refcount = objects[i];
+        void* object = refcount->_object;
+        void (*deleter)(void*) = refcount->_deleter;
+
+        if (refcount->reconcile())
+        {
+            (*deleter)(object);
+            ++destroyed;
+        }
+    }
+
+    return destroyed;
+}
+
+bool CBiasedRefCount::merge()
+{
+    // 偏向计数可能为负（拥有线程减少了其它线程增加的引用），一并合并
+    const int64_t shared = __atomic_add_fetch(&_shared, _biased*COUNT_ONE + MERGED, __ATOMIC_ACQ_REL);
+    _biased = 0;
+    _merged = true;
+
+    // 已交给拥有线程的，留给merge_pending销毁，否则队列中会留下已销毁的对象
+    return MERGED == shared;
+}
+
+bool CBiasedRefCount::dec_shared()
+{
+    int64_t old_shared = __atomic_load_n(&_shared, __ATOMIC_RELAXED);
+    int64_t new_shared;
+
+    for (;;)
+    {
+        new_shared = old_shared - COUNT_ONE;
+
+        // 未合并时不知道拥有线程还有多少偏向计数，可能已没有引用了，在同一个原子操作中标记交给拥有线程，
+        // 标记之后只有处理队列者才能销毁对象，保证入队前对象不被销毁
+        if ((0 == (old_shared & (MERGED|QUEUED))) && ((new_shared >> 2) <= 0))
+            new_shared |= QUEUED;
+        if (__atomic_compare_exchange_n(&_shared, &old_shared, new_shared, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if ((new_shared & MERGED) != 0)
+        return MERGED == new_shared;
+    if ((new_shared & QUEUED) != 0 && (0 == (old_shared & QUEUED)))
+    {
+        bool exited;
+        Queue* queue = _queue;
+
+        pthread_mutex_lock(&queue->lock);
+        exited = queue->exited;
+        if (!exited)
+        {
+            queue->objects.push_back(this);
+            __atomic_store_n(&queue->number, static_cast<uint32_t>(queue->objects.size()), __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        // 拥有线程已退出，偏向计数不会再变，由交出者合并
+        if (exited)
+            return reconcile();
+    }
+
+    return false;
+}
+
+bool CBiasedRefCount::reconcile()
+{
+    // 合并偏向计数（如果还未合并）并清除交出标记，两者在同一个原子操作中，
+    // 之后其它线程减到0时由它们自己销毁
+    const int64_t delta = (_merged? 0: _biased*COUNT_ONE + MERGED) - QUEUED;
+    const int64_t shared = __atomic_add_fetch(&_shared, delta, __ATOMIC_ACQ_REL);
+    _biased = 0;
+    _merged = true;
+    return MERGED == shared;
+}
+
+CBiasedRefCount::Queue* CBiasedRefCount::get_queue()
+{
+    if (NULL == _thread_queue)
+    {
+        Queue* queue = new Queue;
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->exited = false;
+        queue->number = 0;
+
+        (void)pthread_once(&sg_queue_once, create_queue_key);
+        (void)pthread_setspecific(sg_queue_key, queue);
+        _thread_queue = queue;
+    }
+
+    return _thread_queue;
+}
+
+SYS_NAMESPACE_END
@@ -19,6 +19,7 @@
 #include "sys/report_self.h"
 #include "ReportSelfService.h"
 #include <inttypes.h>
+#include <sys/stat.h>
 #include <mooon/net/utils.h>
 #include <mooon/net/thrift_helper.h>
 #include <mooon/sys/datetime_utils.h>
@@ -68,7 +69,8 @@ private:
     std::string _ethX;
     std::vector<std::pair<std::string, uint16_t> > _report_servers;
     std::pair<uint64_t, uint64_t> _mem;
-    sys::CInfo::process_info_t _process_info;
+    sys::CInfoSampler _sampler; // 保持/proc文件打开，每次上报不用重新打开
+    time_t _conf_mtime; // 配置文件未修改时不重新解析
 
 private:
     uint32_t _pid; // 进程ID
@@ -151,10 +153,9 @@ bool start_report_self(const std::string& conffile, uint32_t report_interval_sec
 
 CReportSelf::CReportSelf(const std::string& conffile, uint32_t report_interval_seconds)
     : _conffile(conffile), _report_interval_seconds(report_interval_seconds+1),
-      _stop(false)
+      _stop(false), _conf_mtime(0)
 {
     _pid = sys::CUtils::get_current_process_id();
-    memset(&_process_info, 0, sizeof(_process_info));
 }
 
 CReportSelf::~CReportSelf()
@@ -201,6 +202,16 @@ bool CReportSelf::init_conf()
 
     try
     {
+        struct stat st;
+        if (-1 == stat(_conffile.c_str(), &st))
+        {
+            st.st_mtime = 0;
+        }
+        else if ((st.st_mtime == _conf_mtime) && !_report_servers.empty())
+        {
+            return true;
+        }
+
         _report_servers.clear();
 
         // 如果不指定配置文件，则认为不想启用
@@ -276,6 +287,7 @@ bool CReportSelf::init_conf()
             }
 
             sys::CMMap::unmap(ptr);
+            _conf_mtime = st.st_mtime;
             return true;
         } while(false);
 
@@ -317,16 +329,10 @@ void CReportSelf::report()
     if (init_conf())
     {
         const std::string& current = sys::CDatetimeUtils::get_current_datetime();
-        if (!sys::CInfo::get_process_info(&_process_info))
-        {
-            _mem.first = 0;
-            _mem.second = 0;
-        }
-        else
-        {
-            _mem.first = _process_info.vsize;
-            _mem.second = _process_info.rss * sys::CUtils::get_page_size();
-        }
+        sys::CInfoSampler::resource_rates_t rates;
+        (void)_sampler.sample(&rates);
+        _mem.first = rates.process_vsize;
+        _mem.second = rates.process_rss;
 
         std::vector<std::string> tokens(11);
         tokens[0] = _full_cmdline_md5;
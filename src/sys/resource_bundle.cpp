@@ -0,0 +1,402 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/resource_bundle.h"
+#include "sys/syscall_exception.h"
+#include "utils/hash_utils.h"
+#include "utils/string_utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+static const char BUNDLE_MAGIC[8] = { 'M', 'O', 'O', 'O', 'N', 'R', 'B', '1' };
+static const char TRAILER_MAGIC[8] = { 'M', 'O', 'O', 'O', 'N', 'R', 'B', 'T' };
+static const uint32_t BUNDLE_VERSION = 1;
+
+// 资源包的头部
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_number;
+    uint32_t bucket_number;
+    uint32_t reserved;
+    uint64_t bundle_size;
+}bundle_header_t;
+
+// 附加在文件末尾的尾部，紧跟在资源包之后
+typedef struct
+{
+    uint64_t bundle_size;
+    char magic[8];
+}bundle_trailer_t;
+
+static size_t align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static uint32_t get_bucket_number(uint32_t entry_number)
+{
+    uint32_t bucket_number = 2;
+    while (bucket_number < entry_number * 2)
+        bucket_number <<= 1;
+    return bucket_number;
+}
+
+static void write_file_data(int fd, const std::string& data, const std::string& filepath)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        const ssize_t bytes = ::write(fd, data.data()+written, data.size()-written);
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+
+            const int errcode = errno;
+            ::close(fd);
+            THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("write %s error: %s", filepath.c_str(), strerror(errcode)), errcode, "write");
+        }
+
+        written += static_cast<size_t>(bytes);
+    }
+}
+
+CResourceBundle::CResourceBundle()
+    : _bundle(NULL), _size(0), _entry_number(0), _bucket_mask(0), _buckets(NULL), _entries(NULL),
+      _mmap(NULL), _cached_bytes(0)
+{
+}
+
+CResourceBundle::~CResourceBundle()
+{
+    close();
+}
+
+void CResourceBundle::open(const void* data, size_t size)
+{
+    bundle_header_t header;
+    const char* bundle = static_cast<const char*>(data);
+
+    close();
+    if (size < sizeof(header))
+        THROW_EXCEPTION("resource bundle too small", EINVAL);
+    memcpy(&header, bundle, sizeof(header));
+    if (memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0)
+        THROW_EXCEPTION("invalid resource bundle magic", EINVAL);
+    if (header.version != BUNDLE_VERSION)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("unsupported resource bundle version: %u", header.version), EINVAL);
+    if ((header.bundle_size > size) || (0 == header.bucket_number) ||
+        ((header.bucket_number & (header.bucket_number - 1)) != 0) || (header.entry_number > header.bucket_number / 2))
+        THROW_EXCEPTION("corrupted resource bundle header", EINVAL);
+
+    // 校验所有的偏移，之后访问不再检查
+    const size_t buckets_offset = sizeof(header);
+    const size_t entries_offset = align_up(buckets_offset + header.bucket_number * sizeof(uint32_t), 8);
+    const size_t entries_end = entries_offset + header.entry_number * sizeof(resource_entry_t);
+    if (entries_end > header.bundle_size)
+        THROW_EXCEPTION("corrupted resource bundle index", EINVAL);
+    if ((reinterpret_cast<uintptr_t>(bundle) % 8) != 0)
+        THROW_EXCEPTION("resource bundle not aligned to 8 bytes", EINVAL);
+
+    const uint32_t* buckets = reinterpret_cast<const uint32_t*>(bundle + buckets_offset);
+    const resource_entry_t* entries = reinterpret_cast<const resource_entry_t*>(bundle + entries_offset);
+    for (uint32_t i=0; i<header.bucket_number; ++i)
+    {
+        if (buckets[i] > header.entry_number)
+            THROW_EXCEPTION("corrupted resource bundle bucket", EINVAL);
+    }
+    for (uint32_t i=0; i<header.entry_number; ++i)
+    {
+        const resource_entry_t& entry = entries[i];
+        if ((entry.name_offset > header.bundle_size) || (entry.name_length > header.bundle_size - entry.name_offset) ||
+            (entry.data_offset > header.bundle_size) || (entry.stored_size > header.bundle_size - entry.data_offset) ||
+            (entry.compression >= utils::compression_max) ||
+            ((utils::compression_none == entry.compression) && (entry.stored_size != entry.original_size)))
+            THROW_EXCEPTION(utils::CStringUtils::format_string("corrupted resource bundle entry: %u", i), EINVAL);
+    }
+
+    _bundle = bundle;
+    _size = static_cast<size_t>(header.bundle_size);
+    _entry_number = header.entry_number;
+    _bucket_mask = header.bucket_number - 1;
+    _buckets = buckets;
+    _entries = entries;
+    _cache.assign(_entry_number, NULL);
+}
+
+void CResourceBundle::open_file(const std::string& filepath)
+{
+    close();
+
+    mmap_t* ptr = CMMap::map_read(filepath.c_str());
+    const char* data = static_cast<const char*>(ptr->addr);
+    size_t offset = 0;
+    size_t size = ptr->len;
+
+    try
+    {
+        if ((NULL == data) || (size < sizeof(bundle_header_t)))
+            THROW_EXCEPTION(utils::CStringUtils::format_string("no resource bundle in %s", filepath.c_str()), EINVAL);
+
+        // 文件本身不是资源包时，从末尾的尾部找到附加的资源包
+        if (memcmp(data, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0)
+        {
+            bundle_trailer_t trailer;
+            memcpy(&trailer, data+size-sizeof(trailer), sizeof(trailer));
+            if ((memcmp(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0) ||
+                (trailer.bundle_size > size - sizeof(trailer)))
+                THROW_EXCEPTION(utils::CStringUtils::format_string("no resource bundle in %s", filepath.c_str()), EINVAL);
+
+            size = static_cast<size_t>(trailer.bundle_size);
+            offset = ptr->len - sizeof(trailer) - size;
+        }
+
+        open(data+offset, size);
+        _mmap = ptr;
+    }
+    catch (...)
+    {
+        CMMap::unmap(ptr);
+        throw;
+    }
+}
+
+void CResourceBundle::open_self()
+{
+    open_file("/proc/self/exe");
+}
+
+void CResourceBundle::close()
+{
+    for (std::vector<std::string*>::size_type i=0; i<_cache.size(); ++i)
+        delete _cache[i];
+    _cache.clear();
+    _cached_bytes = 0;
+
+    if (_mmap != NULL)
+    {
+        CMMap::unmap(_mmap);
+        _mmap = NULL;
+    }
+
+    _bundle = NULL;
+    _size = 0;
+    _entry_number = 0;
+    _bucket_mask = 0;
+    _buckets = NULL;
+    _entries = NULL;
+}
+
+int CResourceBundle::find(const std::string& name) const
+{
+    if (NULL == _bundle)
+        return -1;
+
+    // 负载不超过一半，总能遇到空桶结束
+    for (uint32_t bucket=static_cast<uint32_t>(utils::CHashUtils::xxhash64(name)) & _bucket_mask;; bucket=(bucket+1) & _bucket_mask)
+    {
+        const uint32_t index = _buckets[bucket];
+        if (0 == index)
+            return -1;
+
+        const resource_entry_t& entry = _entries[index-1];
+        if ((entry.name_length == name.size()) && (0 == memcmp(_bundle+entry.name_offset, name.data(), name.size())))
+            return static_cast<int>(index - 1);
+    }
+}
+
+std::string CResourceBundle::get_name(uint32_t index) const
+{
+    const resource_entry_t& entry = _entries[index];
+    return std::string(_bundle+entry.name_offset, entry.name_length);
+}
+
+const char* CResourceBundle::get(const std::string& name, size_t* size)
+{
+    const int index = find(name);
+    return (-1 == index)? NULL: get(static_cast<uint32_t>(index), size);
+}
+
+const char* CResourceBundle::get(uint32_t index, size_t* size)
+{
+    const resource_entry_t& entry = _entries[index];
+
+    *size = static_cast<size_t>(entry.original_size);
+    if (utils::compression_none == entry.compression)
+        return _bundle + entry.data_offset;
+
+    // 已解压过的不加锁
+    std::string* data = __atomic_load_n(&_cache[index], __ATOMIC_ACQUIRE);
+    if (NULL == data)
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        data = _cache[index];
+        if (NULL == data)
+        {
+            std::string* decompressed = new std::string;
+            try
+            {
+                decompressed->reserve(static_cast<std::string::size_type>(entry.original_size));
+                utils::decompress_data(static_cast<utils::compression_t>(entry.compression),
+                                       _bundle+entry.data_offset, static_cast<size_t>(entry.stored_size), decompressed);
+                if (decompressed->size() != entry.original_size)
+                    THROW_EXCEPTION(utils::CStringUtils::format_string("resource[%s] size mismatch", get_name(index).c_str()), EINVAL);
+            }
+            catch (...)
+            {
+                delete decompressed;
+                throw;
+            }
+
+            data = decompressed;
+            __atomic_add_fetch(&_cached_bytes, data->capacity(), __ATOMIC_RELAXED);
+            __atomic_store_n(&_cache[index], data, __ATOMIC_RELEASE);
+        }
+    }
+
+    return data->data();
+}
+
+void CResourceBundleWriter::add(const std::string& name, const std::string& data, utils::compression_t compression)
+{
+    for (std::vector<std::string>::size_type i=0; i<_names.size(); ++i)
+    {
+        if (_names[i] == name)
+            THROW_EXCEPTION(utils::CStringUtils::format_string("duplicate resource: %s", name.c_str()), EEXIST);
+    }
+
+    Resource resource;
+    resource.original_size = data.size();
+    resource.compression = utils::compression_none;
+    if ((compression != utils::compression_none) && !data.empty())
+    {
+        std::string compressed;
+        utils::compress_data(compression, data.data(), data.size(), &compressed);
+        if (compressed.size() < data.size())
+        {
+            resource.data.swap(compressed);
+            resource.compression = compression;
+        }
+    }
+    if (utils::compression_none == resource.compression)
+        resource.data = data;
+
+    _names.push_back(name);
+    _resources.push_back(resource);
+}
+
+void CResourceBundleWriter::write(std::string* bundle) const
+{
+    const uint32_t entry_number = static_cast<uint32_t>(_names.size());
+    const uint32_t bucket_number = get_bucket_number(entry_number);
+    const size_t buckets_offset = sizeof(bundle_header_t);
+    const size_t entries_offset = align_up(buckets_offset + bucket_number * sizeof(uint32_t), 8);
+    const size_t names_offset = entries_offset + entry_number * sizeof(resource_entry_t);
+    std::vector<uint32_t> buckets(bucket_number, 0);
+    std::vector<resource_entry_t> entries(entry_number);
+
+    // 先排好名字和数据的位置
+    size_t offset = names_offset;
+    for (uint32_t i=0; i<entry_number; ++i)
+    {
+        entries[i].name_offset = offset;
+        entries[i].name_length = static_cast<uint32_t>(_names[i].size());
+        offset += _names[i].size();
+    }
+    for (uint32_t i=0; i<entry_number; ++i)
+    {
+        offset = align_up(offset, 16);
+        entries[i].data_offset = offset;
+        entries[i].stored_size = _resources[i].data.size();
+        entries[i].original_size = _resources[i].original_size;
+        entries[i].compression = static_cast<uint32_t>(_resources[i].compression);
+        offset += _resources[i].data.size();
+
+        uint32_t bucket = static_cast<uint32_t>(utils::CHashUtils::xxhash64(_names[i])) & (bucket_number - 1);
+        while (buckets[bucket] != 0)
+            bucket = (bucket + 1) & (bucket_number - 1);
+        buckets[bucket] = i + 1;
+    }
+
+    bundle_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    header.version = BUNDLE_VERSION;
+    header.entry_number = entry_number;
+    header.bucket_number = bucket_number;
+    header.bundle_size = align_up(offset, 16);
+
+    // 资源包在bundle中的起始位置不一定对齐，偏移都是相对资源包的
+    const std::string::size_type base = bundle->size();
+    bundle->resize(base + static_cast<std::string::size_type>(header.bundle_size), '\0');
+    char* data = const_cast<char*>(bundle->data()) + base;
+    memcpy(data, &header, sizeof(header));
+    memcpy(data+buckets_offset, &buckets[0], bucket_number*sizeof(uint32_t));
+    if (entry_number > 0)
+        memcpy(data+entries_offset, &entries[0], entry_number*sizeof(resource_entry_t));
+    for (uint32_t i=0; i<entry_number; ++i)
+    {
+        memcpy(data+entries[i].name_offset, _names[i].data(), _names[i].size());
+        memcpy(data+entries[i].data_offset, _resources[i].data.data(), _resources[i].data.size());
+    }
+}
+
+void CResourceBundleWriter::write_file(const std::string& filepath) const
+{
+    std::string bundle;
+    write(&bundle);
+
+    const int fd = ::open(filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("open %s error: %s", filepath.c_str(), strerror(errno)), errno, "open");
+    write_file_data(fd, bundle, filepath);
+    ::close(fd);
+}
+
+void CResourceBundleWriter::append_to_file(const std::string& filepath) const
+{
+    const int fd = ::open(filepath.c_str(), O_WRONLY|O_APPEND);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("open %s error: %s", filepath.c_str(), strerror(errno)), errno, "open");
+
+    const off_t file_size = lseek(fd, 0, SEEK_END);
+    if (-1 == file_size)
+    {
+        const int errcode = errno;
+        ::close(fd);
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("lseek %s error: %s", filepath.c_str(), strerror(errcode)), errcode, "lseek");
+    }
+
+    // 以0填充使资源包在文件中按16字节对齐，mmap后即对齐
+    std::string data(align_up(static_cast<size_t>(file_size), 16) - static_cast<size_t>(file_size), '\0');
+    write(&data);
+
+    bundle_trailer_t trailer;
+    trailer.bundle_size = data.size() - (align_up(static_cast<size_t>(file_size), 16) - static_cast<size_t>(file_size));
+    memcpy(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+    data.append(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+    write_file_data(fd, data, filepath);
+    ::close(fd);
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,70 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/robust_mutex.h"
+SYS_NAMESPACE_BEGIN
+
+void CRobustMutex::init(pthread_mutex_t* mutex)
+{
+    pthread_mutexattr_t attr;
+    int errcode = pthread_mutexattr_init(&attr);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutexattr_init");
+
+    errcode = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    if (0 == errcode)
+        errcode = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (errcode != 0)
+    {
+        pthread_mutexattr_destroy(&attr);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutexattr_set");
+    }
+
+    errcode = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_init");
+}
+
+bool CRobustMutex::lock()
+{
+    int errcode = pthread_mutex_lock(_mutex);
+    if (0 == errcode)
+        return false;
+
+    if (EOWNERDEAD == errcode)
+    {
+        // 已得到锁，标记为一致后锁才可继续使用，否则解锁后变为ENOTRECOVERABLE
+        errcode = pthread_mutex_consistent(_mutex);
+        if (0 == errcode)
+            return true;
+        (void)pthread_mutex_unlock(_mutex);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_consistent");
+    }
+
+    THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_lock");
+}
+
+void CRobustMutex::unlock()
+{
+    int errcode = pthread_mutex_unlock(_mutex);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_mutex_unlock");
+}
+
+SYS_NAMESPACE_END
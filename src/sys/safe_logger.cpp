@@ -19,22 +19,234 @@
 #include "mooon/sys/safe_logger.h"
 #include "mooon/sys/close_helper.h"
 #include "mooon/sys/datetime_utils.h"
+#include "mooon/sys/dir_utils.h"
 #include "mooon/sys/file_locker.h"
 #include "mooon/sys/file_utils.h"
+#include "mooon/sys/robust_mutex.h"
+#include "mooon/sys/thread.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/crc32.h"
 #include "mooon/utils/scoped_ptr.h"
 #include "mooon/utils/string_utils.h"
+#include <algorithm>
+#include <ctype.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sstream>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <syslog.h>
 #include <unistd.h>
 SYS_NAMESPACE_BEGIN
 
+// 异步写日志的后台线程，定时将各线程缓冲区中的日志写入文件
+class CAsyncLogFlusher: public CThread
+{
+public:
+    CAsyncLogFlusher(CSafeLogger* logger, uint32_t flush_milliseconds)
+        : _logger(logger), _flush_milliseconds(flush_milliseconds)
+    {
+    }
+
+private:
+    virtual void run()
+    {
+        while (!is_stop())
+        {
+            do_millisleep(static_cast<int>(_flush_milliseconds));
+            _logger->flush();
+        }
+    }
+
+private:
+    CSafeLogger* _logger;
+    uint32_t _flush_milliseconds;
+};
+
+// 归档的后台线程，压缩滚动出的文件并删除超过备份个数的旧文件
+class CLogArchiver: public CThread
+{
+public:
+    CLogArchiver(CSafeLogger* logger)
+        : _logger(logger)
+    {
+    }
+
+    void add(const std::string& filepath)
+    {
+        {
+            LockHelper<CLock> lock_helper(_filepaths_lock);
+            _filepaths.push_back(filepath);
+        }
+        wakeup();
+    }
+
+    void archive()
+    {
+        std::vector<std::string> filepaths;
+        {
+            LockHelper<CLock> lock_helper(_filepaths_lock);
+            filepaths.swap(_filepaths);
+        }
+        if (!filepaths.empty())
+            _logger->archive_files(filepaths);
+    }
+
+private:
+    virtual void run()
+    {
+        while (!is_stop())
+        {
+            do_millisleep(1000);
+            archive();
+        }
+    }
+
+private:
+    CSafeLogger* _logger;
+    CLock _filepaths_lock;
+    std::vector<std::string> _filepaths; // 待归档的文件
+};
+
+// 每次fork后在子进程中加1，分片据此发现自己在子进程中
+static uint32_t sg_fork_generation = 0;
+static pthread_once_t sg_atfork_once = PTHREAD_ONCE_INIT;
+
+static void on_fork_child()
+{
+    __atomic_add_fetch(&sg_fork_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void register_atfork()
+{
+    (void)pthread_atfork(NULL, NULL, on_fork_child);
+}
+
+static uint64_t get_realtime_nanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
 static uint64_t get_current_thread_id()
 {
     return static_cast<uint64_t>(pthread_self());
 }
 
+// 往日志行中追加内容，超出部分被截断
+static void append_log_header(char* log_line, int* length, int max_length, const char* str, int str_length)
+{
+    if (*length + str_length > max_length)
+        str_length = max_length - *length;
+    if (str_length > 0)
+    {
+        memcpy(log_line + *length, str, str_length);
+        *length += str_length;
+    }
+}
+
+// 滚动出的文件名中的时间，按时间滚动时为所属周期
+static std::string get_rotate_stamp(time_t t, log_rotate_t rotate)
+{
+    struct tm result;
+    char stamp[sizeof("YYYYmmddHHMMSS")];
+    const char* format = (log_rotate_hourly == rotate)? "%Y%m%d%H": ((log_rotate_daily == rotate)? "%Y%m%d": "%Y%m%d%H%M%S");
+
+    localtime_r(&t, &result);
+    strftime(stamp, sizeof(stamp), format, &result);
+    return stamp;
+}
+
+// t所在周期的开始时间，以本地时间的整点或零点为界
+static time_t get_period_start(time_t t, log_rotate_t rotate)
+{
+    struct tm result;
+    localtime_r(&t, &result);
+    result.tm_min = 0;
+    result.tm_sec = 0;
+    if (log_rotate_daily == rotate)
+        result.tm_hour = 0;
+    result.tm_isdst = -1;
+    return mktime(&result);
+}
+
+static time_t get_next_period(time_t period_start, log_rotate_t rotate)
+{
+    struct tm result;
+    localtime_r(&period_start, &result);
+    if (log_rotate_hourly == rotate)
+        ++result.tm_hour;
+    else
+        ++result.tm_mday;
+    result.tm_isdst = -1;
+    return mktime(&result);
+}
+
+// 写完全部数据，被信号中断时继续写
+static bool write_fully(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t bytes = write(fd, data, size);
+        if ((bytes < 0) && (EINTR == errno))
+            continue;
+        if (bytes <= 0)
+            return false;
+        data += bytes;
+        size -= static_cast<size_t>(bytes);
+    }
+    return true;
+}
+
+// 滚动出的文件是否已存在，包括已被压缩的（不论以哪种方式）
+static bool rotated_exists(const std::string& filepath)
+{
+    if (0 == access(filepath.c_str(), F_OK))
+        return true;
+    for (int i=utils::compression_gzip; i<utils::compression_max; ++i)
+    {
+        const char* suffix = utils::get_compression_suffix(static_cast<utils::compression_t>(i));
+        if (0 == access((filepath + suffix).c_str(), F_OK))
+            return true;
+    }
+    return false;
+}
+
+// 滚动出的文件名为“x.log.时间[.序号][.gz]”（或其它压缩后缀），按（时间，序号）排序即按滚动的先后排序，
+// 按时间滚动时不带序号的是周期结束时滚动的，排在同一周期内带序号的之后
+struct RotatedName
+{
+    std::string stamp;
+    uint64_t sequence;
+    std::string name;
+
+    bool operator <(const RotatedName& other) const
+    {
+        if (stamp != other.stamp)
+            return stamp < other.stamp;
+        return sequence < other.sequence;
+    }
+};
+
+static RotatedName parse_rotated_name(const std::string& name, std::string::size_type prefix_size, bool bare_last)
+{
+    RotatedName rotated_name;
+    std::string::size_type dot = name.find('.', prefix_size);
+
+    rotated_name.name = name;
+    rotated_name.stamp = name.substr(prefix_size, (std::string::npos == dot)? std::string::npos: dot - prefix_size);
+    rotated_name.sequence = bare_last? UINT64_MAX: 0;
+    if ((dot != std::string::npos) && (dot + 1 < name.size()) && isdigit(static_cast<unsigned char>(name[dot+1])))
+        rotated_name.sequence = strtoull(name.c_str() + dot + 1, NULL, 10);
+    return rotated_name;
+}
+
 CSafeLogger* create_safe_logger(
         bool enable_program_path,
         uint16_t log_line_size,
@@ -91,6 +303,19 @@ CSafeLogger* create_safe_logger(
     return logger;
 }
 
+// 同一日志文件的各进程共享的滚动状态，放在以文件路径命名的POSIX共享内存中
+struct CSafeLogger::SharedRotation
+{
+    uint32_t magic;          // 初始化完成后才设置为SHARED_ROTATION_MAGIC，只在共享内存文件的锁内读写
+    pthread_mutex_t mutex;   // 互斥滚动，代替.lock文件锁
+    uint64_t file_size;      // 当前文件的大小，各进程写入后原子地累加
+    uint64_t generation;     // 滚动的次数，变化说明其它进程已滚动了文件
+    char filepath[PATH_MAX]; // 日志文件的路径，名字是路径的哈希值，用来发现冲突
+};
+
+#define SHARED_ROTATION_MAGIC 0x4D4C5331 // "MLS1"
+#define SHARED_ROTATION_PROBES 8         // 名字的哈希冲突时最多尝试的个数
+
 ////////////////////////////////////////////////////////////////////////////////
 CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t log_line_size, bool enable_syslog)
     :_log_fd(-1)
@@ -101,12 +326,30 @@ CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t
     ,_trace_log_enabled(false)
     ,_raw_log_enabled(false)
     ,_raw_record_time(false)
+    ,_microseconds_enabled(true)
+    ,_time_thread(NULL)
     ,_screen_enabled(false)
     ,_log_dir(log_dir)
     ,_log_filename(log_filename)
     ,_log_filepath(_log_dir + std::string("/") + _log_filename)
     ,_log_shortname(mooon::utils::CStringUtils::remove_suffix(log_filename))
+    ,_async_buffer_bytes(0)
+    ,_async_flusher(NULL)
+    ,_shard_enabled(false)
+    ,_archiver(NULL)
+    ,_rotate(log_rotate_size)
+    ,_compress_enabled(false)
+    ,_archive_compression(utils::compression_gzip)
+    ,_archive_level(-1)
+    ,_preallocate_enabled(false)
+    ,_file_period_start(0)
+    ,_next_rotate_time(0)
+    ,_shared_rotation(NULL)
+    ,_log_generation(0)
 {
+    _flush_lock.set_contention_name("safe_logger.flush");
+    _log_buffers_lock.set_contention_name("safe_logger.buffers");
+    _log_shards_lock.set_contention_name("safe_logger.shards");
     atomic_set(&_max_bytes, DEFAULT_LOG_FILE_SIZE);
     atomic_set(&_log_level, LOG_LEVEL_INFO);
     atomic_set(&_backup_number, DEFAULT_LOG_FILE_BACKUP_NUMBER);
@@ -133,10 +376,26 @@ CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t
 
         THROW_SYSCALL_EXCEPTION(_log_filepath, errcode, "open");
     }
+
+    // 失败时退回到.lock文件锁
+    attach_shared_rotation();
 }
 
 CSafeLogger::~CSafeLogger()
 {
+    unpublish_log_level(this);
+
+    // 报告还未报告的重复行
+    log_level_t repeated_level;
+    const uint32_t repeated_number = _repeat_filter.take_repeated(&repeated_level);
+    if (repeated_number > 0)
+        log_repeated(repeated_level, repeated_number);
+
+    // 先写完异步缓冲的日志，再关闭文件，最后完成未完成的归档
+    release_log_buffers();
+    release_log_shards();
+    release_archiver();
+
     if (_log_fd != -1)
     {
         if (close(_log_fd) != 0)
@@ -146,6 +405,10 @@ CSafeLogger::~CSafeLogger()
         }
     }
 
+    // 共享内存不删除，其它进程可能还在用，下次启动时继续使用
+    if (_shared_rotation != NULL)
+        (void)munmap(_shared_rotation, sizeof(SharedRotation));
+
     if (_sys_log_enabled)
         closelog();
 }
@@ -201,6 +464,11 @@ void CSafeLogger::enable_auto_adddot(bool enabled)
     _auto_adddot = enabled;
 }
 
+void CSafeLogger::enable_repeat_filter(bool enabled)
+{
+    _repeat_filter.enable(enabled);
+}
+
 void CSafeLogger::enable_auto_newline(bool enabled)
 {
     _auto_newline = enabled;
@@ -209,6 +477,7 @@ void CSafeLogger::enable_auto_newline(bool enabled)
 void CSafeLogger::set_log_level(log_level_t log_level)
 {
     atomic_set(&_log_level, log_level);
+    publish_log_level(this);
 }
 
 void CSafeLogger::set_single_filesize(uint32_t filesize)
@@ -452,10 +721,23 @@ void CSafeLogger::log_bin(const char* filename, int lineno, const char* module_n
 
 bool CSafeLogger::need_rotate(int fd) const
 {
-    off_t file_size = CFileUtils::get_file_size(fd);
+    if (is_rotate_due())
+        return true;
+
+    // 共享了滚动状态时，文件大小由各进程写入后累加，不需要fstat
+    const off_t file_size = (_shared_rotation != NULL)?
+        static_cast<off_t>(__atomic_load_n(&_shared_rotation->file_size, __ATOMIC_RELAXED)):
+        CFileUtils::get_file_size(fd);
     return file_size > static_cast<off_t>(atomic_read(&_max_bytes));
 }
 
+// 其它进程已滚动了文件，当前进程的_log_fd还指向滚动前的文件
+bool CSafeLogger::is_log_stale() const
+{
+    return (_shared_rotation != NULL)
+        && (__atomic_load_n(&_shared_rotation->generation, __ATOMIC_ACQUIRE) != __atomic_load_n(&_log_generation, __ATOMIC_RELAXED));
+}
+
 void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
 {
     int log_real_size = 0;
@@ -477,28 +759,57 @@ void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno
     }
     else
     {
-        std::stringstream log_header; // 每条日志的头
         char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
-        get_formatted_current_datetime(datetime, sizeof(datetime));
+        const int datetime_length = get_cached_formatted_datetime(datetime, sizeof(datetime), _microseconds_enabled, _time_thread);
 
         // 日志头内容：[日期][线程ID/进程ID][日志级别][模块名][代码文件名][代码行号]
-        log_header << "[" << datetime << "]"
-                   << "[" << get_current_thread_id() << "/" << getpid() << "]"
-                   << "[" << get_log_level_name(log_level) << "]";
+        // 构造时已保证_log_line_size不小于LOG_LINE_SIZE_MIN，日期、线程ID、进程ID和级别总是放得下
+        char number[sizeof("18446744073709551615")];
+        const int max_length = _log_line_size - 1;
+        int m = 0;
+        log_line_p[m++] = '[';
+        append_log_header(log_line_p, &m, max_length, datetime, datetime_length);
+        append_log_header(log_line_p, &m, max_length, "][", 2);
+        append_log_header(log_line_p, &m, max_length, number, utils::CStringUtils::uint64_toa(get_current_thread_id(), number));
+        append_log_header(log_line_p, &m, max_length, "/", 1);
+        append_log_header(log_line_p, &m, max_length, number, utils::CStringUtils::uint64_toa(static_cast<uint64_t>(getpid()), number));
+        append_log_header(log_line_p, &m, max_length, "][", 2);
+        const char* log_level_name = get_log_level_name(log_level);
+        append_log_header(log_line_p, &m, max_length, log_level_name, static_cast<int>(strlen(log_level_name)));
+        append_log_header(log_line_p, &m, max_length, "]", 1);
         if (module_name != NULL)
-            log_header << "[" << module_name << "]";
+        {
+            append_log_header(log_line_p, &m, max_length, "[", 1);
+            append_log_header(log_line_p, &m, max_length, module_name, static_cast<int>(strlen(module_name)));
+            append_log_header(log_line_p, &m, max_length, "]", 1);
+        }
         if (filename != NULL)
-            log_header << "[" << utils::CStringUtils::extract_filename(filename) << ":" << lineno << "]";
-
-        int m, n;
-        // 注意fix_snprintf()的返回值大小包含了结尾符
-        m = utils::CStringUtils::fix_snprintf(log_line_p, _log_line_size, "%s", log_header.str().c_str());
+        {
+            const char* only_filename = utils::CStringUtils::extract_filename(filename);
+            append_log_header(log_line_p, &m, max_length, "[", 1);
+            append_log_header(log_line_p, &m, max_length, only_filename, static_cast<int>(strlen(only_filename)));
+            append_log_header(log_line_p, &m, max_length, ":", 1);
+            append_log_header(log_line_p, &m, max_length, number, utils::CStringUtils::uint64_toa(static_cast<uint64_t>((lineno < 0)? 0: lineno), number));
+            append_log_header(log_line_p, &m, max_length, "]", 1);
+        }
+        log_line_p[m++] = '\0'; // 和fix_snprintf()一样，m包含了结尾符
 
+        int n;
         if (LOG_LEVEL_BIN == log_level)
             n = utils::CStringUtils::fix_snprintf(log_line_p+m-1, _log_line_size-m, "%s", format);
         else
             n = utils::CStringUtils::fix_vsnprintf(log_line_p+m-1, _log_line_size-m, format, args);
         log_real_size = m + n - 2; // 减去2个结尾符
+
+        if (_repeat_filter.is_enabled() && (log_level != LOG_LEVEL_BIN))
+        {
+            uint32_t repeated_number = 0;
+            log_level_t repeated_level;
+            if (_repeat_filter.filter(log_level, filename, lineno, log_line_p+m-1, n-1, &repeated_number, &repeated_level))
+                return;
+            if (repeated_number > 0)
+                log_repeated(repeated_level, repeated_number);
+        }
     }
 
     // 是否自动添加结尾用的点号
@@ -520,28 +831,57 @@ void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno
             ++log_real_size;
         }
     }
+    output_log(log_line_p, log_real_size);
+}
+
+void CSafeLogger::output_log(const char* log_line, int log_line_size)
+{
     if (_screen_enabled) // 允许打屏
     {
-        (void)write(STDOUT_FILENO, log_line_p, log_real_size);
+        (void)write(STDOUT_FILENO, log_line, log_line_size);
     }
 
-    if (false)
+    if (_shard_enabled)
+    {
+        // 写入本线程的分片
+        shard_log(log_line, log_line_size);
+    }
+    else if (_async_flusher != NULL)
     {
         // 异步写入日志文件
-        //log_line.release();
+        async_log(log_line, log_line_size);
     }
     else
     {
         // 同步写入日志文件
-        write_log(log_line_p, log_real_size);
+        write_log(log_line, log_line_size);
     }
 }
 
+// 重复行的汇总，没有代码位置，不再经过重复过滤
+void CSafeLogger::log_repeated(log_level_t log_level, uint32_t repeated_number)
+{
+    char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
+    char log_line[LOG_LINE_SIZE_MIN];
+
+    (void)get_cached_formatted_datetime(datetime, sizeof(datetime), _microseconds_enabled, _time_thread);
+    const int length = utils::CStringUtils::fix_snprintf(
+        log_line, sizeof(log_line), "[%s][%" PRIu64"/%u][%s]last message repeated %u times\n",
+        datetime, get_current_thread_id(), static_cast<unsigned int>(getpid()), get_log_level_name(log_level), repeated_number) - 1;
+    output_log(log_line, length);
+}
+
 void CSafeLogger::rotate_log()
 {
     std::string new_path;  // 滚动后的文件路径，包含目录和文件名
     std::string old_path;  // 滚动前的文件路径，包含目录和文件名
 
+    if (_archiver != NULL)
+    {
+        archive_log();
+        return;
+    }
+
     // 历史滚动
     int backup_number = atomic_read(&_backup_number);
     for (int i=backup_number-1; i>1; --i)
@@ -620,66 +960,754 @@ void CSafeLogger::write_log(const char* log_line, int log_line_size)
     }
     else if (bytes > 0)
     {
-        try
+        if (_shared_rotation != NULL)
+            __atomic_add_fetch(&_shared_rotation->file_size, static_cast<uint64_t>(bytes), __ATOMIC_RELAXED);
+        check_rotate(log_fd.get());
+    }
+}
+
+void CSafeLogger::check_rotate(int log_fd)
+{
+    try
+    {
+        // 判断是否需要滚动，或者是否已被其它进程滚动
+        if (need_rotate(log_fd) || is_log_stale())
         {
-            // 判断是否需要滚动
-            if (need_rotate(log_fd.get()))
+            // 确保这里一定加锁，以互斥多进程
+            if (_shared_rotation != NULL)
+            {
+                CRobustMutex robust_mutex(&_shared_rotation->mutex);
+                RobustLockHelper lock_helper(robust_mutex);
+                reopen_log();
+            }
+            else
             {
                 std::string lock_path = _log_dir + std::string("/.") + _log_filename + std::string(".lock");
-                FileLocker file_locker(lock_path.c_str(), true); // 确保这里一定加锁，以互斥多进程
+                FileLocker file_locker(lock_path.c_str(), true);
+                reopen_log();
+            }
+        }
+    }
+    catch (CSyscallException& syscall_ex)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+    }
+}
 
-                // _fd可能已被其它进程或线程滚动了，所以这里需要重新open一下
-                int new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
-                if (-1 == new_log_fd)
-                {
-                    if (_sys_log_enabled)
-                        syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
-                }
-                else
+// 在滚动锁内调用，需要时滚动，然后重新打开
+void CSafeLogger::reopen_log()
+{
+    // _fd可能已被其它进程或线程滚动了，所以这里需要重新open一下
+    int new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+    if (-1 == new_log_fd)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+        return;
+    }
+
+    try
+    {
+        // 以实际大小为准，纠正累加的误差，如进程在写入后、累加前退出了，或文件被外部删除了
+        sync_shared_size(new_log_fd);
+
+        if (need_rotate(new_log_fd))
+        {
+            rotate_log();
+            close(new_log_fd);
+
+            // new_log_fd被滚动了，需要重新打开
+            new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+            if (-1 == new_log_fd)
+            {
+                if (_sys_log_enabled)
+                    syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+            }
+            else if (_preallocate_enabled)
+            {
+                preallocate_log(new_log_fd);
+            }
+
+            // 其它进程据此发现文件已被滚动
+            sync_shared_size(new_log_fd);
+            if (_shared_rotation != NULL)
+                __atomic_add_fetch(&_shared_rotation->generation, 1, __ATOMIC_RELEASE);
+        }
+
+        // 不管谁滚动的，都需要重设_log_fd，
+        // 原因是如果是由其它进程滚动的，则当前进程的_log_fd是不会变化的
+        WriteLockHelper rlh(_read_write_lock); // 确保这里一定加锁，以互斥同一进程的多线程
+        if (0 == close(_log_fd))
+            _log_fd = new_log_fd;
+        else if (new_log_fd != -1)
+            close(new_log_fd);
+        if (_shared_rotation != NULL)
+            __atomic_store_n(&_log_generation, __atomic_load_n(&_shared_rotation->generation, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    }
+    catch (CSyscallException& syscall_ex)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+    }
+}
+
+// 在滚动锁内调用，fd为-1时表示文件不存在
+void CSafeLogger::sync_shared_size(int fd)
+{
+    if (_shared_rotation != NULL)
+    {
+        const uint64_t file_size = (-1 == fd)? 0: static_cast<uint64_t>(CFileUtils::get_file_size(fd));
+        __atomic_store_n(&_shared_rotation->file_size, file_size, __ATOMIC_RELAXED);
+    }
+}
+
+void CSafeLogger::enable_async(uint32_t flush_milliseconds, uint32_t buffer_bytes)
+{
+    if (_async_flusher != NULL)
+        return;
+    if (_shard_enabled)
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, "enable_async");
+
+    const int errcode = pthread_key_create(&_log_buffer_key, on_thread_exit);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_key_create");
+
+    // 缓冲区至少能放下一行日志
+    _async_buffer_bytes = (buffer_bytes < _log_line_size)? _log_line_size: buffer_bytes;
+    CAsyncLogFlusher* async_flusher = new CAsyncLogFlusher(this, (0 == flush_milliseconds)? 1: flush_milliseconds);
+    async_flusher->inc_refcount();
+
+    try
+    {
+        async_flusher->start();
+    }
+    catch (CSyscallException&)
+    {
+        async_flusher->dec_refcount();
+        pthread_key_delete(_log_buffer_key);
+        throw;
+    }
+
+    _async_flusher = async_flusher;
+}
+
+void CSafeLogger::enable_shard()
+{
+    if (_shard_enabled)
+        return;
+    if (_async_flusher != NULL)
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, "enable_shard");
+
+    const int errcode = pthread_key_create(&_shard_key, on_shard_exit);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_key_create");
+    (void)pthread_once(&sg_atfork_once, register_atfork);
+    _shard_enabled = true;
+}
+
+void CSafeLogger::on_shard_exit(void* param)
+{
+    LogShard* shard = static_cast<LogShard*>(param);
+    CSafeLogger* logger = shard->logger;
+    LockHelper<CLock> lock_helper(logger->_log_shards_lock);
+
+    std::vector<LogShard*>::iterator iter = std::find(logger->_log_shards.begin(), logger->_log_shards.end(), shard);
+    if (iter != logger->_log_shards.end())
+        logger->_log_shards.erase(iter);
+    if (shard->fd != -1)
+        close(shard->fd);
+    delete shard;
+}
+
+// 只访问本线程的分片，不加锁，只在线程第一次写日志时登记
+void CSafeLogger::shard_log(const char* log_line, int log_line_size)
+{
+    LogShard* shard = static_cast<LogShard*>(pthread_getspecific(_shard_key));
+    if (NULL == shard)
+    {
+        shard = new LogShard;
+        shard->logger = this;
+        shard->fd = -1;
+        shard->generation = __atomic_load_n(&sg_fork_generation, __ATOMIC_RELAXED);
+        shard->birth = get_realtime_nanoseconds();
+        shard->sequence = 0;
+        shard->segment = 0;
+        shard->size = 0;
+        pthread_setspecific(_shard_key, shard);
+
+        LockHelper<CLock> lock_helper(_log_shards_lock);
+        _log_shards.push_back(shard);
+    }
+
+    const uint32_t generation = __atomic_load_n(&sg_fork_generation, __ATOMIC_RELAXED);
+    if (shard->generation != generation)
+    {
+        // 子进程不再写父进程的分片
+        if (shard->fd != -1)
+            close(shard->fd);
+        shard->fd = -1;
+        shard->generation = generation;
+        shard->birth = get_realtime_nanoseconds();
+        shard->sequence = 0;
+        shard->segment = 0;
+    }
+    if ((-1 == shard->fd) || (shard->size >= static_cast<off_t>(atomic_read(&_max_bytes))))
+    {
+        if (!open_shard_segment(shard))
+            return;
+    }
+
+    // 格式：实时纳秒时间 序号 长度 日志行
+    char header[sizeof("18446744073709551615 18446744073709551615 4294967295 ")];
+    const int header_size = snprintf(header, sizeof(header), "%" PRIu64" %" PRIu64" %d ", get_realtime_nanoseconds(), ++shard->sequence, log_line_size);
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = header_size;
+    iov[1].iov_base = const_cast<char*>(log_line);
+    iov[1].iov_len = log_line_size;
+
+    const ssize_t bytes = writev(shard->fd, iov, 2);
+    if (bytes > 0)
+    {
+        shard->size += bytes;
+    }
+    else
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] writev failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+    }
+}
+
+// 打开下一段，并删除超过备份个数的旧段
+bool CSafeLogger::open_shard_segment(LogShard* shard)
+{
+    const std::string shard_prefix = utils::CStringUtils::format_string("%s.shard.%u.%ld.%" PRIu64".",
+            _log_filepath.c_str(), getpid(), static_cast<long>(syscall(SYS_gettid)), shard->birth);
+    const std::string segment_path = shard_prefix + utils::CStringUtils::int_tostring(++shard->segment);
+
+    if (shard->fd != -1)
+        close(shard->fd);
+    shard->size = 0;
+    shard->fd = open(segment_path.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+    if (-1 == shard->fd)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), segment_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    const uint32_t backup_number = static_cast<uint32_t>(atomic_read(&_backup_number));
+    if (shard->segment > backup_number + 1)
+    {
+        const std::string old_path = shard_prefix + utils::CStringUtils::int_tostring(shard->segment - backup_number - 1);
+        (void)unlink(old_path.c_str());
+    }
+    return true;
+}
+
+void CSafeLogger::release_log_shards()
+{
+    if (_shard_enabled)
+    {
+        // 删除key后，线程退出时不再回调on_shard_exit，所以这里关闭所有分片
+        pthread_key_delete(_shard_key);
+        _shard_enabled = false;
+
+        LockHelper<CLock> lock_helper(_log_shards_lock);
+        for (std::vector<LogShard*>::size_type i=0; i<_log_shards.size(); ++i)
+        {
+            if (_log_shards[i]->fd != -1)
+                close(_log_shards[i]->fd);
+            delete _log_shards[i];
+        }
+        _log_shards.clear();
+    }
+}
+
+void CSafeLogger::flush()
+{
+    std::vector<std::string> log_lines;
+    LockHelper<CLock> flush_lock_helper(_flush_lock);
+
+    {
+        LockHelper<CLock> lock_helper(_log_buffers_lock);
+        for (std::vector<ThreadLogBuffer*>::iterator iter=_log_buffers.begin(); iter!=_log_buffers.end();)
+        {
+            ThreadLogBuffer* log_buffer = *iter;
+            bool exited;
+
+            {
+                LockHelper<CLock> buffer_lock_helper(log_buffer->lock);
+                if (!log_buffer->data.empty())
                 {
-                    try
-                    {
-                        if (need_rotate(new_log_fd))
-                        {
-                            rotate_log();
-                            close(new_log_fd);
-
-                            // new_log_fd被滚动了，需要重新打开
-                            new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
-                            if (-1 == new_log_fd)
-                            {
-                                if (_sys_log_enabled)
-                                    syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
-                            }
-                        }
-
-                        // 不管谁滚动的，都需要重设_log_fd，
-                        // 原因是如果是由其它进程滚动的，则当前进程的_log_fd是不会变化的
-                        WriteLockHelper rlh(_read_write_lock); // 确保这里一定加锁，以互斥同一进程的多线程
-                        if (0 == close(_log_fd))
-                            _log_fd = new_log_fd;
-                        else if (new_log_fd != -1)
-                            close(new_log_fd);
-                    }
-                    catch (CSyscallException& syscall_ex)
-                    {
-                        if (_sys_log_enabled)
-                            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
-                    }
+                    log_lines.push_back(std::string());
+                    log_lines.back().swap(log_buffer->data);
+                    if (!log_buffer->exited)
+                        log_buffer->data.reserve(_async_buffer_bytes);
                 }
+
+                exited = log_buffer->exited;
+            }
+
+            if (exited)
+            {
+                delete log_buffer;
+                iter = _log_buffers.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    if (!log_lines.empty())
+        writev_log(log_lines);
+}
+
+void CSafeLogger::on_thread_exit(void* param)
+{
+    // 缓冲区中可能还有日志，由后台线程写完后再删除
+    ThreadLogBuffer* log_buffer = static_cast<ThreadLogBuffer*>(param);
+    LockHelper<CLock> lock_helper(log_buffer->lock);
+    log_buffer->exited = true;
+}
+
+CSafeLogger::ThreadLogBuffer* CSafeLogger::get_thread_log_buffer()
+{
+    ThreadLogBuffer* log_buffer = static_cast<ThreadLogBuffer*>(pthread_getspecific(_log_buffer_key));
+    if (NULL == log_buffer)
+    {
+        log_buffer = new ThreadLogBuffer;
+        log_buffer->logger = this;
+        log_buffer->exited = false;
+        log_buffer->data.reserve(_async_buffer_bytes);
+        pthread_setspecific(_log_buffer_key, log_buffer);
+
+        LockHelper<CLock> lock_helper(_log_buffers_lock);
+        _log_buffers.push_back(log_buffer);
+    }
+
+    return log_buffer;
+}
+
+void CSafeLogger::async_log(const char* log_line, int log_line_size)
+{
+    ThreadLogBuffer* log_buffer = get_thread_log_buffer();
+    std::string::size_type size;
+
+    {
+        LockHelper<CLock> lock_helper(log_buffer->lock);
+        log_buffer->data.append(log_line, log_line_size);
+        size = log_buffer->data.size();
+    }
+
+    if (size >= 4 * static_cast<std::string::size_type>(_async_buffer_bytes))
+        flush(); // 后台线程跟不上，由调用线程自己写
+    else if (size >= _async_buffer_bytes)
+        _async_flusher->wakeup();
+}
+
+void CSafeLogger::writev_log(std::vector<std::string>& log_lines)
+{
+    CloseHelper<int> log_fd(prepare_log_fd());
+    if (-1 == log_fd.get())
+    {
+        return; // 没法继续
+    }
+
+    uint64_t written_bytes = 0;
+    struct iovec iov_array[IOV_MAX];
+    std::vector<std::string>::size_type i = 0;
+    while (i < log_lines.size())
+    {
+        int number = 0;
+        for (; (i<log_lines.size()) && (number<IOV_MAX); ++i, ++number)
+        {
+            iov_array[number].iov_base = const_cast<char*>(log_lines[i].data());
+            iov_array[number].iov_len = log_lines[i].size();
+        }
+
+        ssize_t bytes = writev(log_fd.get(), iov_array, number);
+        if (bytes > 0)
+        {
+            written_bytes += static_cast<uint64_t>(bytes);
+        }
+        else
+        {
+            if (_sys_log_enabled)
+                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] writev failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+        }
+    }
+
+    // 整批写完后再判断是否需要滚动
+    if (written_bytes > 0)
+    {
+        if (_shared_rotation != NULL)
+            __atomic_add_fetch(&_shared_rotation->file_size, written_bytes, __ATOMIC_RELAXED);
+        check_rotate(log_fd.get());
+    }
+}
+
+void CSafeLogger::release_log_buffers()
+{
+    if (_async_flusher != NULL)
+    {
+        _async_flusher->stop();
+        _async_flusher->dec_refcount();
+        flush();
+
+        // 删除key后，线程退出时不再回调on_thread_exit，所以这里释放所有缓冲区
+        pthread_key_delete(_log_buffer_key);
+        _async_flusher = NULL;
+
+        LockHelper<CLock> lock_helper(_log_buffers_lock);
+        for (std::vector<ThreadLogBuffer*>::size_type i=0; i<_log_buffers.size(); ++i)
+            delete _log_buffers[i];
+        _log_buffers.clear();
+    }
+}
+
+void CSafeLogger::set_archive_compression(utils::compression_t compression, int level)
+{
+    if (!utils::is_compression_supported(compression))
+        THROW_EXCEPTION(utils::CStringUtils::format_string("compression %s not supported", utils::get_compression_name(compression)), ENOTSUP);
+
+    _archive_compression = compression;
+    _archive_level = level;
+}
+
+void CSafeLogger::enable_archive(log_rotate_t rotate, bool compress, bool preallocate)
+{
+    if (_archiver != NULL)
+        return;
+
+    // 已有内容的文件属于最后修改时间所在的周期，重启后首次写日志时即可滚动上一周期的文件
+    const time_t now = time(NULL);
+    struct stat st;
+    const time_t file_time = ((0 == fstat(_log_fd, &st)) && (st.st_size > 0))? st.st_mtime: now;
+    _rotate = rotate;
+    _compress_enabled = compress;
+    _preallocate_enabled = preallocate;
+    if (rotate != log_rotate_size)
+    {
+        _file_period_start = get_period_start(file_time, rotate);
+        _next_rotate_time = get_next_period(_file_period_start, rotate);
+    }
+    if (preallocate)
+        preallocate_log(_log_fd);
+
+    CLogArchiver* archiver = new CLogArchiver(this);
+    archiver->inc_refcount();
+
+    try
+    {
+        archiver->start();
+    }
+    catch (CSyscallException&)
+    {
+        archiver->dec_refcount();
+        _rotate = log_rotate_size;
+        throw;
+    }
+
+    _archiver = archiver;
+}
+
+// 在滚动锁内调用，只重命名，压缩和删除交给后台线程
+void CSafeLogger::archive_log()
+{
+    const time_t now = time(NULL);
+    const std::string prefix = _log_filepath + std::string(".");
+    std::string new_path;
+
+    if ((_rotate != log_rotate_size) && (now >= _next_rotate_time))
+    {
+        // 按周期命名，已存在说明已被其它进程滚动，当前的文件已是新周期的
+        new_path = prefix + get_rotate_stamp(_file_period_start, _rotate);
+        if (rotated_exists(new_path))
+            new_path.clear();
+
+        _file_period_start = get_period_start(now, _rotate);
+        __atomic_store_n(&_next_rotate_time, get_next_period(_file_period_start, _rotate), __ATOMIC_RELAXED);
+    }
+    else
+    {
+        // 按时间滚动时，不带序号的文件名留给周期结束时的滚动
+        const std::string stamp_path = prefix + get_rotate_stamp((log_rotate_size == _rotate)? now: _file_period_start, _rotate);
+        int sequence = (log_rotate_size == _rotate)? 0: 1;
+
+        new_path = (0 == sequence)? stamp_path: stamp_path + std::string(".1");
+        while (rotated_exists(new_path))
+            new_path = stamp_path + std::string(".") + utils::CStringUtils::int_tostring(++sequence);
+    }
+
+    if (!new_path.empty())
+    {
+        if (-1 == rename(_log_filepath.c_str(), new_path.c_str()))
+        {
+            if (_sys_log_enabled)
+                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] rename to %s failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), new_path.c_str(), strerror(errno));
+        }
+        else
+        {
+            _archiver->add(new_path);
+        }
+    }
+}
+
+// 在后台线程中调用
+void CSafeLogger::archive_files(const std::vector<std::string>& filepaths)
+{
+    if (_compress_enabled && (atomic_read(&_backup_number) > 0))
+    {
+        for (std::vector<std::string>::size_type i=0; i<filepaths.size(); ++i)
+            compress_log(filepaths[i]);
+    }
+
+    remove_old_logs();
+}
+
+// 先压缩到临时文件，完成后再改名并删除原文件，中途出错则保留原文件
+void CSafeLogger::compress_log(const std::string& filepath) const
+{
+    const std::string compressed_path = filepath + std::string(utils::get_compression_suffix(_archive_compression));
+    const std::string tmp_path = compressed_path + std::string(".tmp");
+    if (utils::compression_none == _archive_compression)
+        return;
+
+    CloseHelper<int> fd(open(filepath.c_str(), O_RDONLY));
+    if (-1 == fd.get())
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), filepath.c_str(), strerror(errno));
+        return;
+    }
+
+    CloseHelper<int> tmp_fd(open(tmp_path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM));
+    if (-1 == tmp_fd.get())
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), tmp_path.c_str(), strerror(errno));
+        return;
+    }
+
+    // 归档线程专用的压缩器，复用其上下文
+    bool ok = true;
+    std::string compressed;
+    std::vector<char> buffer(SIZE_64K);
+    try
+    {
+        utils::CCompressor* compressor = utils::CCompressor::get_thread_compressor(_archive_compression, _archive_level);
+        for (bool eof=false; ok && !eof;)
+        {
+            const ssize_t bytes = read(fd.get(), &buffer[0], buffer.size());
+            if ((bytes < 0) && (EINTR == errno))
+                continue;
+            if (bytes < 0)
+            {
+                ok = false;
+                break;
             }
+
+            eof = (0 == bytes);
+            compressed.clear();
+            compressor->compress(&buffer[0], static_cast<size_t>(bytes), &compressed);
+            if (eof)
+                compressor->finish(&compressed);
+            ok = write_fully(tmp_fd.get(), compressed.data(), compressed.size());
+        }
+    }
+    catch (utils::CException& ex)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] compress failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), filepath.c_str(), ex.str().c_str());
+        ok = false;
+    }
+    if (-1 == close(tmp_fd.release()))
+        ok = false;
+
+    if (ok && (0 == rename(tmp_path.c_str(), compressed_path.c_str())))
+    {
+        (void)unlink(filepath.c_str());
+    }
+    else
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] compress failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), filepath.c_str(), strerror(errno));
+        (void)unlink(tmp_path.c_str());
+    }
+}
+
+void CSafeLogger::remove_old_logs() const
+{
+    const std::string prefix = _log_filename + std::string(".");
+    const std::string::size_type backup_number = static_cast<std::string::size_type>(atomic_read(&_backup_number));
+    std::vector<std::string> file_names;
+    std::vector<RotatedName> rotated_names;
+
+    try
+    {
+        CDirUtils::list(_log_dir, NULL, &file_names);
+    }
+    catch (CSyscallException& syscall_ex)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_dir.c_str(), syscall_ex.str().c_str());
+        return;
+    }
+
+    for (std::vector<std::string>::size_type i=0; i<file_names.size(); ++i)
+    {
+        const std::string& file_name = file_names[i];
+        const bool is_tmp = (file_name.size() > 4) && (0 == file_name.compare(file_name.size()-4, 4, ".tmp"));
+        if ((0 == file_name.compare(0, prefix.size(), prefix)) && !is_tmp)
+            rotated_names.push_back(parse_rotated_name(file_name, prefix.size(), _rotate != log_rotate_size));
+    }
+    if (rotated_names.size() <= backup_number)
+        return;
+
+    std::sort(rotated_names.begin(), rotated_names.end());
+    for (std::vector<std::string>::size_type i=0; i<rotated_names.size()-backup_number; ++i)
+    {
+        const std::string filepath = _log_dir + std::string("/") + rotated_names[i].name;
+        if ((-1 == unlink(filepath.c_str())) && (errno != ENOENT))
+        {
+            if (_sys_log_enabled)
+                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"] unlink %s failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), filepath.c_str(), strerror(errno));
+        }
+    }
+}
+
+// FALLOC_FL_KEEP_SIZE不改变文件大小，O_APPEND写入仍追加在已有内容之后
+void CSafeLogger::preallocate_log(int fd) const
+{
+    if ((-1 == fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(atomic_read(&_max_bytes)))) && (errno != EOPNOTSUPP))
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] fallocate failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+    }
+}
+
+void CSafeLogger::release_archiver()
+{
+    if (_archiver != NULL)
+    {
+        _archiver->stop();
+        _archiver->archive();
+        _archiver->dec_refcount();
+        _archiver = NULL;
+    }
+}
+
+// 打开或创建名为name的共享内存，在共享内存文件的锁内初始化或检查，
+// 被其它日志文件占用（名字的哈希冲突）时返回NULL并设置collided
+CSafeLogger::SharedRotation* CSafeLogger::open_shared_rotation(const char* name, const char* filepath, bool* collided)
+{
+    *collided = false;
+    int fd = shm_open(name, O_RDWR|O_CREAT, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] shm_open %s failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), name, strerror(errno));
+        return NULL;
+    }
+
+    // 共享内存文件在本地的tmpfs上，只在这里加文件锁，持有者退出时锁自动释放，
+    // 所以创建者初始化到一半就退出了的，由下一个进程重新初始化，不会因等待超时而各用各的锁
+    void* addr = MAP_FAILED;
+    struct stat st;
+    if ((0 == flock(fd, LOCK_EX)) && (0 == fstat(fd, &st)))
+    {
+        if (0 == st.st_size)
+            (void)fchmod(fd, FILE_DEFAULT_PERM); // 不受umask影响，能写日志文件的进程都能打开
+        if ((st.st_size >= static_cast<off_t>(sizeof(SharedRotation))) || (0 == ftruncate(fd, sizeof(SharedRotation))))
+            addr = mmap(NULL, sizeof(SharedRotation), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (MAP_FAILED == addr)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] map %s failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    SharedRotation* shared_rotation = static_cast<SharedRotation*>(addr);
+    if (shared_rotation->magic != SHARED_ROTATION_MAGIC)
+    {
+        try
+        {
+            CRobustMutex::init(&shared_rotation->mutex);
+            shared_rotation->file_size = static_cast<uint64_t>(CFileUtils::get_file_size(_log_fd));
+            shared_rotation->generation = 0;
+            strcpy(shared_rotation->filepath, filepath);
+            shared_rotation->magic = SHARED_ROTATION_MAGIC;
         }
         catch (CSyscallException& syscall_ex)
         {
             if (_sys_log_enabled)
-                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), syscall_ex.str().c_str());
+            (void)munmap(addr, sizeof(SharedRotation));
+            shared_rotation = NULL;
+        }
+    }
+    else if (strcmp(shared_rotation->filepath, filepath) != 0)
+    {
+        *collided = true;
+        (void)munmap(addr, sizeof(SharedRotation));
+        shared_rotation = NULL;
+    }
+
+    close(fd); // 同时释放文件锁
+    return shared_rotation;
+}
+
+void CSafeLogger::attach_shared_rotation()
+{
+    char real_path[PATH_MAX];
+    const char* filepath = (NULL == realpath(_log_filepath.c_str(), real_path))? _log_filepath.c_str(): real_path;
+    const size_t filepath_length = strlen(filepath);
+    if (filepath_length >= PATH_MAX)
+        return;
+
+    // 同一文件的不同写法（如相对路径和符号链接）经realpath后相同，
+    // 哈希冲突时依次尝试加后缀的名字，同一文件的进程按同样的顺序尝试，总是用同一个
+    const uint32_t crc32 = utils::CCrc32::crc32(filepath, filepath_length);
+    const uint32_t crc32c = utils::CCrc32::crc32c(filepath, filepath_length);
+    char name[sizeof("/mooon_log_0123456789abcdef_99")];
+    for (int i=0; i<SHARED_ROTATION_PROBES; ++i)
+    {
+        if (0 == i)
+            snprintf(name, sizeof(name), "/mooon_log_%08x%08x", crc32, crc32c);
+        else
+            snprintf(name, sizeof(name), "/mooon_log_%08x%08x_%d", crc32, crc32c, i);
+
+        bool collided = false;
+        SharedRotation* shared_rotation = open_shared_rotation(name, filepath, &collided);
+        if (shared_rotation != NULL)
+        {
+            _log_generation = __atomic_load_n(&shared_rotation->generation, __ATOMIC_ACQUIRE);
+            _shared_rotation = shared_rotation;
+            return;
         }
+        if (!collided)
+            break;
     }
 }
 
+bool CSafeLogger::is_rotate_due() const
+{
+    return (_rotate != log_rotate_size) && (time(NULL) >= __atomic_load_n(&_next_rotate_time, __ATOMIC_RELAXED));
+}
+
 int CSafeLogger::prepare_log_fd()
 {
     int log_fd = -1;
+
+    // 按时间滚动在写入前进行，新周期的第一条日志即写入新文件
+    if (is_rotate_due())
+        check_rotate(-1);
     {
         ReadLockHelper rlh(_read_write_lock);
         if (_log_fd != -1)
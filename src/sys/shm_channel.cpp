@@ -0,0 +1,424 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/shm_channel.h"
+#include "sys/clock.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+#define SHM_CHANNEL_MAGIC   0x4D534843 // "CHSM"
+#define SHM_CHANNEL_VERSION 1
+#define SHM_CHANNEL_HEADER_SIZE 4096   // 头独占一页，环形缓冲区从第二页开始
+
+// 消息头为64位：低32位为有符号的长度（包含头，负数表示已占用未提交），高32位为类型
+#define RECORD_MESSAGE 1
+#define RECORD_PADDING 2
+
+// 各字段分处不同的缓存行，避免生产者和消费者互相使对方的缓存行失效，
+// 跨进程共享，一律以__atomic访问
+struct CShmChannel::ChannelHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t reserved;
+    char padding1[48];
+    uint64_t tail;             // 生产者已占用到的位置
+    char padding2[56];
+    uint64_t head;             // 消费者已消费到的位置，只有消费者修改
+    char padding3[56];
+    uint32_t data_seq;         // 每次提交递增，消费者在其上futex等待
+    uint32_t consumer_waiting;
+    char padding4[56];
+    uint32_t space_seq;        // 每次释放空间递增，生产者在其上futex等待
+    uint32_t producer_waiting;
+};
+
+static inline uint64_t make_record(uint32_t type, int32_t length)
+{
+    return (static_cast<uint64_t>(type) << 32) | static_cast<uint32_t>(length);
+}
+
+static inline uint32_t get_record_type(uint64_t record)
+{
+    return static_cast<uint32_t>(record >> 32);
+}
+
+static inline int32_t get_record_length(uint64_t record)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(record));
+}
+
+static inline uint64_t align8(uint64_t size)
+{
+    return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+// 共享内存中的futex不能用FUTEX_PRIVATE_FLAG
+static void futex_wait(uint32_t* addr, uint32_t value, uint32_t milliseconds)
+{
+    struct timespec timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+    (void)syscall(SYS_futex, addr, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t* addr)
+{
+    (void)syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+CShmChannel::CShmChannel()
+    : _fd(-1), _owned_fd(false), _header(NULL), _ring(NULL), _mapped_size(0), _capacity(0),
+      _stalled_head(UINT64_MAX), _stalled_milliseconds(0)
+{
+}
+
+CShmChannel::~CShmChannel()
+{
+    close();
+}
+
+bool CShmChannel::create(const char* name, uint32_t capacity)
+{
+    uint32_t ring_capacity = 4096;
+    while ((ring_capacity < capacity) && (ring_capacity < 0x80000000))
+        ring_capacity <<= 1;
+
+    int fd = (NULL == name)? memfd_create("mooon_shm_channel", 0): shm_open(name, O_RDWR|O_CREAT, 0600);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, (NULL == name)? "memfd_create": "shm_open");
+
+    struct stat st;
+    if (-1 == fstat(fd, &st))
+    {
+        int errcode = errno;
+        ::close(fd);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "fstat");
+    }
+
+    // 已存在的，如进程重启后，继续使用
+    if (st.st_size > 0)
+    {
+        attach(fd, true, 0);
+        return false;
+    }
+
+    if (-1 == ftruncate(fd, SHM_CHANNEL_HEADER_SIZE+static_cast<off_t>(ring_capacity)))
+    {
+        int errcode = errno;
+        ::close(fd);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "ftruncate");
+    }
+
+    attach(fd, true, ring_capacity);
+    return true;
+}
+
+void CShmChannel::open(const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "shm_open");
+    attach(fd, true, 0);
+}
+
+void CShmChannel::open_fd(int fd)
+{
+    attach(fd, false, 0);
+}
+
+void CShmChannel::close()
+{
+    if (_header != NULL)
+    {
+        (void)munmap(_header, _mapped_size);
+        _header = NULL;
+        _ring = NULL;
+    }
+    if (_owned_fd && (_fd != -1))
+        ::close(_fd);
+    _fd = -1;
+    _owned_fd = false;
+}
+
+void CShmChannel::remove(const char* name)
+{
+    if ((-1 == shm_unlink(name)) && (errno != ENOENT))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "shm_unlink");
+}
+
+void CShmChannel::attach(int fd, bool owned, uint32_t new_capacity)
+{
+    struct stat st;
+    int errcode = 0;
+    void* addr = MAP_FAILED;
+
+    if (-1 == fstat(fd, &st))
+        errcode = errno;
+    else if (st.st_size <= SHM_CHANNEL_HEADER_SIZE)
+        errcode = EINVAL;
+    else if (MAP_FAILED == (addr = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)))
+        errcode = errno;
+    if (errcode != 0)
+    {
+        if (owned)
+            ::close(fd);
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, (EINVAL == errcode)? NULL: "mmap");
+    }
+
+    ChannelHeader* header = static_cast<ChannelHeader*>(addr);
+    if (new_capacity > 0)
+    {
+        // 新建的内容全为零，魔数最后写，标识已初始化完成
+        header->version = SHM_CHANNEL_VERSION;
+        header->capacity = new_capacity;
+        __atomic_store_n(&header->magic, SHM_CHANNEL_MAGIC, __ATOMIC_RELEASE);
+    }
+    else if ((__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_CHANNEL_MAGIC)
+          || (header->version != SHM_CHANNEL_VERSION)
+          || (static_cast<uint64_t>(st.st_size) != SHM_CHANNEL_HEADER_SIZE+static_cast<uint64_t>(header->capacity)))
+    {
+        (void)munmap(addr, st.st_size);
+        if (owned)
+            ::close(fd);
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, NULL);
+    }
+
+    close();
+    _fd = fd;
+    _owned_fd = owned;
+    _header = header;
+    _ring = static_cast<char*>(addr) + SHM_CHANNEL_HEADER_SIZE;
+    _mapped_size = static_cast<size_t>(st.st_size);
+    _capacity = header->capacity;
+    _stalled_head = UINT64_MAX;
+}
+
+uint64_t* CShmChannel::record_at(uint64_t position) const
+{
+    return reinterpret_cast<uint64_t*>(_ring + (position & (_capacity-1)));
+}
+
+char* CShmChannel::claim(uint32_t size)
+{
+    if (size > get_max_message_size())
+        return NULL;
+
+    const uint64_t required = align8(8 + size);
+    uint64_t tail = __atomic_load_n(&_header->tail, __ATOMIC_ACQUIRE);
+    uint64_t padding;
+    for (;;)
+    {
+        // 到环尾的空间不够时，以填充消息补齐到环尾，消息从环首开始
+        const uint64_t head = __atomic_load_n(&_header->head, __ATOMIC_ACQUIRE);
+        const uint64_t to_end = _capacity - (tail & (_capacity-1));
+        padding = (required > to_end)? to_end: 0;
+        if (tail - head + padding + required > _capacity)
+            return NULL;
+        if (__atomic_compare_exchange_n(&_header->tail, &tail, tail+padding+required, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+    }
+
+    // 占用的空间已被recover_stalled当作崩溃的生产者跳过时（头不再为零），放弃
+    uint64_t expected = 0;
+    if ((padding > 0)
+     && !__atomic_compare_exchange_n(record_at(tail), &expected, make_record(RECORD_PADDING, static_cast<int32_t>(padding)), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return NULL;
+
+    uint64_t* record = record_at(tail + padding);
+    expected = 0;
+    if (!__atomic_compare_exchange_n(record, &expected, make_record(RECORD_MESSAGE, -static_cast<int32_t>(8+size)), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return NULL;
+    return reinterpret_cast<char*>(record + 1);
+}
+
+bool CShmChannel::commit(char* data)
+{
+    uint64_t* record = reinterpret_cast<uint64_t*>(data) - 1;
+    uint64_t expected = __atomic_load_n(record, __ATOMIC_RELAXED);
+    const int32_t length = get_record_length(expected);
+
+    if ((RECORD_MESSAGE != get_record_type(expected)) || (length >= 0)
+     || !__atomic_compare_exchange_n(record, &expected, make_record(RECORD_MESSAGE, -length), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return false;
+
+    // 先递增序号再看是否有等待者，与wait中先登记等待再检查相对，不会漏掉唤醒
+    __atomic_add_fetch(&_header->data_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_header->consumer_waiting, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&_header->data_seq);
+    return true;
+}
+
+bool CShmChannel::push(const void* data, uint32_t size)
+{
+    char* buffer = claim(size);
+    if (NULL == buffer)
+        return false;
+
+    memcpy(buffer, data, size);
+    return commit(buffer);
+}
+
+bool CShmChannel::timed_push(const void* data, uint32_t size, uint32_t milliseconds)
+{
+    if (size > get_max_message_size())
+        return false;
+
+    const uint64_t deadline = CClock::get_milliseconds() + milliseconds;
+    for (;;)
+    {
+        const uint32_t seq = __atomic_load_n(&_header->space_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&_header->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        const bool pushed = push(data, size);
+        const uint64_t now = CClock::get_milliseconds();
+        if (!pushed && (now < deadline))
+            futex_wait(&_header->space_seq, seq, static_cast<uint32_t>(deadline-now));
+        __atomic_sub_fetch(&_header->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (pushed || (now >= deadline))
+            return pushed;
+    }
+}
+
+void CShmChannel::skip_padding()
+{
+    for (;;)
+    {
+        const uint64_t head = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+        uint64_t* record = record_at(head);
+        const uint64_t value = __atomic_load_n(record, __ATOMIC_ACQUIRE);
+        if ((RECORD_PADDING != get_record_type(value)) || (get_record_length(value) <= 0))
+            break;
+
+        const uint64_t length = static_cast<uint64_t>(get_record_length(value));
+        memset(record, 0, length);
+        __atomic_store_n(&_header->head, head+length, __ATOMIC_RELEASE);
+    }
+}
+
+bool CShmChannel::front(const char** data, uint32_t* size)
+{
+    skip_padding();
+
+    const uint64_t* record = record_at(__atomic_load_n(&_header->head, __ATOMIC_RELAXED));
+    const int32_t length = get_record_length(__atomic_load_n(record, __ATOMIC_ACQUIRE));
+    if (length <= 0)
+        return false;
+
+    *data = reinterpret_cast<const char*>(record + 1);
+    *size = static_cast<uint32_t>(length - 8);
+    return true;
+}
+
+void CShmChannel::pop()
+{
+    const char* data;
+    uint32_t size;
+    if (!front(&data, &size))
+        return;
+
+    // 清零后生产者才能再用，头之后的空间总是零
+    const uint64_t head = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+    const uint64_t length = align8(8 + size);
+    memset(record_at(head), 0, length);
+    __atomic_store_n(&_header->head, head+length, __ATOMIC_SEQ_CST);
+    skip_padding();
+
+    __atomic_add_fetch(&_header->space_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_header->producer_waiting, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&_header->space_seq);
+}
+
+bool CShmChannel::wait(uint32_t milliseconds)
+{
+    const char* data;
+    uint32_t size;
+    const uint32_t seq = __atomic_load_n(&_header->data_seq, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&_header->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+    if (!front(&data, &size))
+        futex_wait(&_header->data_seq, seq, milliseconds);
+    __atomic_sub_fetch(&_header->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+    return front(&data, &size);
+}
+
+bool CShmChannel::recover_stalled(uint32_t milliseconds)
+{
+    skip_padding();
+
+    const uint64_t head = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+    const uint64_t tail = __atomic_load_n(&_header->tail, __ATOMIC_ACQUIRE);
+    uint64_t* record = record_at(head);
+    uint64_t value = __atomic_load_n(record, __ATOMIC_ACQUIRE);
+    if ((head == tail) || (get_record_length(value) > 0))
+    {
+        _stalled_head = UINT64_MAX;
+        return false;
+    }
+
+    // 第一次发现时记下时间，停留够了才跳过
+    const uint64_t now = CClock::get_milliseconds();
+    if (_stalled_head != head)
+    {
+        _stalled_head = head;
+        _stalled_milliseconds = now;
+    }
+    if (now - _stalled_milliseconds < milliseconds)
+        return false;
+
+    uint64_t length;
+    if (get_record_length(value) < 0)
+    {
+        // 已占用未提交
+        length = align8(static_cast<uint64_t>(-get_record_length(value)));
+    }
+    else
+    {
+        // 已推进tail但头还未写，跳过直到下一个非零的头，不跨过环尾
+        const uint64_t end = std::min(tail, head + (_capacity - (head & (_capacity-1))));
+        uint64_t position = head + 8;
+        while ((position < end) && (0 == __atomic_load_n(record_at(position), __ATOMIC_ACQUIRE)))
+            position += 8;
+        length = position - head;
+    }
+
+    if (!__atomic_compare_exchange_n(record, &value, make_record(RECORD_PADDING, static_cast<int32_t>(length)), false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return false; // 恰好提交了
+
+    _stalled_head = UINT64_MAX;
+    skip_padding();
+    __atomic_add_fetch(&_header->space_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_header->producer_waiting, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&_header->space_seq);
+    return true;
+}
+
+uint64_t CShmChannel::get_used_bytes() const
+{
+    return __atomic_load_n(&_header->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&_header->head, __ATOMIC_ACQUIRE);
+}
+
+SYS_NAMESPACE_END
@@ -17,6 +17,7 @@
  * Author: jian yi, eyjian@qq.com
  */
 #include "sys/signal_handler.h"
+#include <string.h>
 SYS_NAMESPACE_BEGIN
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -25,6 +26,7 @@ SYS_NAMESPACE_BEGIN
 
 sigset_t CSignalHandler::_sigset;
 std::vector<int> CSignalHandler::_signo_array;
+void (*CSignalHandler::_on_fatal)(int signo) = NULL;
 
 bool CSignalHandler::ignore_signal(int signo) throw ()
 {
@@ -61,25 +63,59 @@ bool CSignalHandler::block_signal(int signo) throw ()
     }
 }
 
-int CSignalHandler::wait_signal() throw ()
+bool CSignalHandler::handle_fatal_signals(void (*on_fatal)(int signo)) throw ()
 {
-    int signo; // 发生的信号
-    sigset_t sigset;
+    static const int fatal_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    static char alternate_stack[64 * 1024];
 
-    // 初始化sigset
-    if (-1 == sigemptyset(&sigset))
+    stack_t stack;
+    stack.ss_sp = alternate_stack;
+    stack.ss_size = sizeof(alternate_stack);
+    stack.ss_flags = 0;
+    if (-1 == sigaltstack(&stack, NULL))
     {
-        return -1;
+        return false;
     }
 
-    // 设置sigset
-    for (std::vector<int>::size_type i=0; i<_signo_array.size(); ++i)
+    // SA_RESETHAND使处理函数只执行一次，再次触发时为默认处理
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_fatal_signal;
+    action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+
+    _on_fatal = on_fatal;
+    for (size_t i=0; i<sizeof(fatal_signals)/sizeof(fatal_signals[0]); ++i)
     {
-        if (-1 == sigaddset(&sigset, _signo_array[i]))
+        if (-1 == sigaction(fatal_signals[i], &action, NULL))
         {
-            return -1;
+            return false;
         }
     }
+    return true;
+}
+
+void CSignalHandler::on_fatal_signal(int signo)
+{
+    if (_on_fatal != NULL)
+    {
+        (*_on_fatal)(signo);
+    }
+
+    // 已恢复为默认处理，SIGSEGV等返回后重新执行出错的指令也会再次触发，
+    // 但SIGABRT等由raise或kill发出的不会，所以总是再触发一次
+    (void)raise(signo);
+}
+
+int CSignalHandler::wait_signal() throw ()
+{
+    int signo; // 发生的信号
+    sigset_t sigset;
+
+    if (!get_blocked_signals(&sigset))
+    {
+        return -1;
+    }
 
     // 等待信号发生
     errno = sigwait(&sigset, &signo);
@@ -91,4 +127,24 @@ int CSignalHandler::wait_signal() throw ()
     return signo;
 }
 
+bool CSignalHandler::get_blocked_signals(sigset_t* sigset) throw ()
+{
+    // 初始化sigset
+    if (-1 == sigemptyset(sigset))
+    {
+        return false;
+    }
+
+    // 设置sigset
+    for (std::vector<int>::size_type i=0; i<_signo_array.size(); ++i)
+    {
+        if (-1 == sigaddset(sigset, _signo_array[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 SYS_NAMESPACE_END
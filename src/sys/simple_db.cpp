@@ -218,6 +218,40 @@ std::string CDBConnectionBase::query(const char* format, ...)
     return result;
 }
 
+DBCursor* CDBConnectionBase::open_cursor(const char* format, ...)
+{
+    int excepted = 0;
+    size_t sql_size = _sql_size;
+    utils::ScopedArray<char> sql(new char[sql_size]);
+    va_list ap;
+
+    while (true)
+    {
+        va_start(ap, format);
+        excepted = vsnprintf(sql.get(), sql_size, format, ap);
+        va_end(ap);
+
+        /* If that worked, return the string. */
+        if (excepted > -1 && excepted < (int)sql_size)
+            break;
+
+        /* Else try again with more space. */
+        if (excepted > -1)    /* glibc 2.1 */
+            sql_size = (size_t)excepted + 1; /* precisely what is needed */
+        else           /* glibc 2.0 */
+            sql_size *= 2;  /* twice the old size */
+
+        sql.reset(new char[sql_size]);
+    }
+
+    return do_open_cursor(sql.get(), excepted);
+}
+
+DBCursor* CDBConnectionBase::do_open_cursor(const char* sql, int sql_length)
+{
+    THROW_DB_EXCEPTION(sql, "not supported", DB_NOT_SUPPORTED);
+}
+
 void CDBConnectionBase::ping()
 {
     THROW_DB_EXCEPTION(NULL, "not supported", DB_NOT_SUPPORTED);
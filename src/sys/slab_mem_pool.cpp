@@ -0,0 +1,354 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/slab_mem_pool.h"
+#include <new>
+#include <stdint.h>
+#include <string.h>
+SYS_NAMESPACE_BEGIN
+
+// 级别大小的对齐字节数
+#define SLAB_ALIGNMENT 8
+
+static uint32_t align_up(uint32_t size, uint32_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+CSlabMemPool::CSlabMemPool() throw ()
+    :_large_number(0)
+{
+}
+
+CSlabMemPool::~CSlabMemPool() throw ()
+{
+    destroy();
+}
+
+void CSlabMemPool::destroy() throw ()
+{
+    for (std::vector<CRawMemPool*>::size_type i=0; i<_pools.size(); ++i)
+        delete _pools[i];
+
+    _pools.clear();
+    _stats.clear();
+    _large_number = 0;
+}
+
+void CSlabMemPool::create(uint16_t min_size, uint16_t max_size, uint16_t growth_percent, uint32_t bucket_number, bool use_heap)
+{
+    uint32_t class_size = align_up((0 == min_size)? 1: min_size, SLAB_ALIGNMENT);
+    const uint32_t max_class_size = (max_size < class_size)? class_size: max_size;
+    if (0 == growth_percent)
+        growth_percent = 100;
+
+    destroy();
+    for (;;)
+    {
+        // 最大级别不超过max_size，避免uint16_t溢出
+        if (class_size > max_class_size)
+            class_size = max_class_size;
+
+        CRawMemPool* raw_mem_pool = new CRawMemPool;
+        raw_mem_pool->create(static_cast<uint16_t>(class_size), bucket_number, use_heap, 0);
+        _pools.push_back(raw_mem_pool);
+
+        slab_class_stat_t stat;
+        stat.class_size = class_size;
+        stat.pool_size = bucket_number;
+        stat.used_number = 0;
+        stat.heap_number = 0;
+        stat.requested_bytes = 0;
+        _stats.push_back(stat);
+
+        if (class_size >= max_class_size)
+            break;
+
+        // 增长不足一个对齐单位的，至少增长一个对齐单位
+        uint32_t next_size = align_up(class_size + class_size * growth_percent / 100, SLAB_ALIGNMENT);
+        if (next_size <= class_size)
+            next_size = class_size + SLAB_ALIGNMENT;
+        class_size = next_size;
+    }
+}
+
+int CSlabMemPool::get_class_index(size_t size) const throw ()
+{
+    int low = 0;
+    int high = static_cast<int>(_stats.size()) - 1;
+
+    if ((high < 0) || (size > _stats[high].class_size))
+        return -1;
+
+    // 二分查找不小于size的最小级别
+    while (low < high)
+    {
+        const int middle = low + (high - low) / 2;
+        if (_stats[middle].class_size < size)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+void* CSlabMemPool::allocate(size_t size) throw ()
+{
+    const int index = get_class_index(size);
+    if (-1 == index)
+    {
+        ++_large_number;
+        return new (std::nothrow) char[size];
+    }
+
+    CRawMemPool* raw_mem_pool = _pools[index];
+    slab_class_stat_t& stat = _stats[index];
+    const bool from_heap = (0 == raw_mem_pool->get_available_number());
+
+    void* ptr = raw_mem_pool->allocate();
+    if (ptr != NULL)
+    {
+        ++stat.used_number;
+        stat.requested_bytes += size;
+        if (from_heap)
+            ++stat.heap_number;
+    }
+
+    return ptr;
+}
+
+bool CSlabMemPool::reclaim(void* ptr, size_t size) throw ()
+{
+    if (NULL == ptr)
+        return false;
+
+    const int index = get_class_index(size);
+    if (-1 == index)
+    {
+        if (_large_number > 0)
+            --_large_number;
+        delete [](char*)ptr;
+        return true;
+    }
+
+    CRawMemPool* raw_mem_pool = _pools[index];
+    slab_class_stat_t& stat = _stats[index];
+    const uint32_t available_number = raw_mem_pool->get_available_number();
+
+    if (!raw_mem_pool->reclaim(ptr))
+        return false;
+
+    // 可用数没有增加，说明是从堆上分配的
+    if ((raw_mem_pool->get_available_number() == available_number) && (stat.heap_number > 0))
+        --stat.heap_number;
+    if (stat.used_number > 0)
+        --stat.used_number;
+    stat.requested_bytes = (stat.requested_bytes > size)? stat.requested_bytes - size: 0;
+    return true;
+}
+
+slab_class_stat_t CSlabMemPool::get_class_stat(uint32_t index) const throw ()
+{
+    if (index < _stats.size())
+        return _stats[index];
+
+    slab_class_stat_t stat;
+    memset(&stat, 0, sizeof(stat));
+    return stat;
+}
+
+double CSlabMemPool::get_occupancy() const throw ()
+{
+    uint64_t used_number = 0;
+    uint64_t pool_size = 0;
+
+    for (std::vector<slab_class_stat_t>::size_type i=0; i<_stats.size(); ++i)
+    {
+        used_number += _stats[i].used_number - _stats[i].heap_number;
+        pool_size += _stats[i].pool_size;
+    }
+
+    return (0 == pool_size)? 0.0: static_cast<double>(used_number) / pool_size;
+}
+
+double CSlabMemPool::get_fragmentation() const throw ()
+{
+    uint64_t used_bytes = 0;
+    uint64_t requested_bytes = 0;
+
+    for (std::vector<slab_class_stat_t>::size_type i=0; i<_stats.size(); ++i)
+    {
+        used_bytes += static_cast<uint64_t>(_stats[i].used_number) * _stats[i].class_size;
+        requested_bytes += _stats[i].requested_bytes;
+    }
+
+    return (0 == used_bytes)? 0.0: 1.0 - static_cast<double>(requested_bytes) / used_bytes;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CThreadSlabMemPool
+
+CThreadSlabMemPool::CThreadSlabMemPool()
+{
+    _lock.set_contention_name("slab_mem_pool");
+}
+
+void CThreadSlabMemPool::create(uint16_t min_size, uint16_t max_size, uint16_t growth_percent, uint32_t bucket_number, bool use_heap)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    _slab_mem_pool.create(min_size, max_size, growth_percent, bucket_number, use_heap);
+}
+
+void CThreadSlabMemPool::destroy()
+{
+    LockHelper<CLock> lock_helper(_lock);
+    _slab_mem_pool.destroy();
+}
+
+void* CThreadSlabMemPool::allocate(size_t size)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _slab_mem_pool.allocate(size);
+}
+
+bool CThreadSlabMemPool::reclaim(void* ptr, size_t size)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _slab_mem_pool.reclaim(ptr, size);
+}
+
+uint32_t CThreadSlabMemPool::get_class_number() const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _slab_mem_pool.get_class_number();
+}
+
+slab_class_stat_t CThreadSlabMemPool::get_class_stat(uint32_t index) const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _slab_mem_pool.get_class_stat(index);
+}
+
+double CThreadSlabMemPool::get_occupancy() const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _slab_mem_pool.get_occupancy();
+}
+
+double CThreadSlabMemPool::get_fragmentation() const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _slab_mem_pool.get_fragmentation();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CArena
+
+CArena::CArena(size_t block_size)
+    :_block_size((0 == block_size)? SIZE_4K: block_size)
+    ,_current(NULL)
+    ,_end(NULL)
+    ,_allocated_bytes(0)
+    ,_reserved_bytes(0)
+{
+}
+
+CArena::~CArena()
+{
+    for (std::vector<std::pair<char*, size_t> >::size_type i=0; i<_blocks.size(); ++i)
+        delete []_blocks[i].first;
+    _blocks.clear();
+}
+
+char* CArena::new_block(size_t size)
+{
+    char* block = new char[size];
+    _blocks.push_back(std::make_pair(block, size));
+    _reserved_bytes += size;
+    return block;
+}
+
+void* CArena::allocate(size_t size, size_t alignment)
+{
+    if (0 == alignment)
+        alignment = 1;
+
+    uintptr_t current = reinterpret_cast<uintptr_t>(_current);
+    uintptr_t aligned = (current + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+    if ((NULL == _current) || (aligned + size > reinterpret_cast<uintptr_t>(_end)))
+    {
+        const size_t need_size = size + alignment - 1;
+
+        // 大的单独一块，不影响当前块剩余空间的使用
+        if (need_size > _block_size / 2)
+        {
+            char* block = new_block(need_size);
+            _allocated_bytes += size;
+            aligned = (reinterpret_cast<uintptr_t>(block) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        _current = new_block(_block_size);
+        _end = _current + _block_size;
+        current = reinterpret_cast<uintptr_t>(_current);
+        aligned = (current + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    }
+
+    _current = reinterpret_cast<char*>(aligned + size);
+    _allocated_bytes += size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+char* CArena::strdup(const char* str, size_t length)
+{
+    char* ptr = static_cast<char*>(allocate(length+1, 1));
+    memcpy(ptr, str, length);
+    ptr[length] = '\0';
+    return ptr;
+}
+
+void CArena::reset()
+{
+    // 保留第一个标准大小的块，其它的都归还
+    std::pair<char*, size_t> retained(static_cast<char*>(NULL), 0);
+    for (std::vector<std::pair<char*, size_t> >::size_type i=0; i<_blocks.size(); ++i)
+    {
+        if ((NULL == retained.first) && (_blocks[i].second == _block_size))
+            retained = _blocks[i];
+        else
+            delete []_blocks[i].first;
+    }
+
+    _blocks.clear();
+    _allocated_bytes = 0;
+    _reserved_bytes = 0;
+    _current = NULL;
+    _end = NULL;
+
+    if (retained.first != NULL)
+    {
+        _blocks.push_back(retained);
+        _reserved_bytes = retained.second;
+        _current = retained.first;
+        _end = _current + retained.second;
+    }
+}
+
+SYS_NAMESPACE_END
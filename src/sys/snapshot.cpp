@@ -0,0 +1,354 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/snapshot.h"
+#include "sys/datetime_utils.h"
+#include "sys/log.h"
+#include "sys/syscall_exception.h"
+#include "utils/crc32.h"
+#include "utils/string_utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+static const char SNAPSHOT_MAGIC[8] = { 'M', 'O', 'O', 'O', 'N', 'S', 'S', '1' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+// 快照的头部
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t section_number;
+    uint64_t saved_milliseconds; // 保存时的墙上时间
+    uint64_t snapshot_size;
+}snapshot_header_t;
+
+// 段的头部，之后为名字和数据
+typedef struct
+{
+    uint32_t name_size;
+    uint32_t version;
+    uint64_t data_size;
+    uint32_t checksum;
+    uint32_t reserved;
+}section_header_t;
+
+static size_t align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static void write_fd(int fd, const std::string& data, const char* name)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        const ssize_t bytes = ::write(fd, data.data()+written, data.size()-written);
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("write snapshot %s error: %s", name, strerror(errno)), errno, "write");
+        }
+
+        written += static_cast<size_t>(bytes);
+    }
+}
+
+void CSnapshotWriter::write_string(std::string_view value)
+{
+    write_uint32(static_cast<uint32_t>(value.size()));
+    write(value.data(), value.size());
+}
+
+bool CSnapshotReader::read_string(std::string* value)
+{
+    uint32_t size = 0;
+    if (!read_uint32(&size) || (size > _size - _offset))
+    {
+        _offset = _size;
+        return false;
+    }
+
+    value->assign(_data+_offset, size);
+    _offset += size;
+    return true;
+}
+
+bool CSnapshotReader::read(void* data, size_t size)
+{
+    if ((_offset > _size) || (size > _size - _offset))
+    {
+        _offset = _size;
+        return false;
+    }
+
+    memcpy(data, _data+_offset, size);
+    _offset += size;
+    return true;
+}
+
+CSnapshotManager::CSnapshotManager()
+    : _snapshot(NULL), _elapsed_milliseconds(0)
+{
+}
+
+CSnapshotManager::~CSnapshotManager()
+{
+    (void)release();
+}
+
+bool CSnapshotManager::register_component(const std::string& name, ISnapshotable* component, uint32_t version)
+{
+    Component item;
+    item.component = component;
+    item.version = version;
+    _components[name] = item;
+
+    std::map<std::string, Section>::iterator iter = _sections.find(name);
+    if (iter == _sections.end())
+        return false;
+
+    // 段只能被认领一次
+    const Section section = iter->second;
+    _sections.erase(iter);
+    if (section.version != version)
+    {
+        MYLOG_WARN("Snapshot %s version %u mismatch %u, discarded\n", name.c_str(), section.version, version);
+        return false;
+    }
+    if (utils::CCrc32::crc32c(section.data, section.size, utils::CCrc32::crc32c(name.data(), name.size())) != section.checksum)
+    {
+        MYLOG_ERROR("Snapshot %s checksum mismatch, discarded\n", name.c_str());
+        return false;
+    }
+
+    CSnapshotReader reader(section.data, section.size, _elapsed_milliseconds);
+    if (!component->load_snapshot(&reader))
+    {
+        MYLOG_ERROR("Snapshot %s loaded failed\n", name.c_str());
+        return false;
+    }
+
+    MYLOG_INFO("Snapshot %s restored with %zu bytes\n", name.c_str(), section.size);
+    return true;
+}
+
+void CSnapshotManager::unregister_component(const std::string& name)
+{
+    _components.erase(name);
+}
+
+void CSnapshotManager::save(std::string* snapshot) const
+{
+    const std::string::size_type base = snapshot->size();
+    snapshot_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.section_number = static_cast<uint32_t>(_components.size());
+    header.saved_milliseconds = CDatetimeUtils::get_current_milliseconds();
+    snapshot->append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (std::map<std::string, Component>::const_iterator iter=_components.begin(); iter!=_components.end(); ++iter)
+    {
+        const std::string& name = iter->first;
+        CSnapshotWriter writer;
+        iter->second.component->save_snapshot(&writer);
+
+        const std::string& data = writer.get_data();
+        section_header_t section;
+        memset(&section, 0, sizeof(section));
+        section.name_size = static_cast<uint32_t>(name.size());
+        section.version = iter->second.version;
+        section.data_size = data.size();
+        section.checksum = utils::CCrc32::crc32c(data.data(), data.size(), utils::CCrc32::crc32c(name.data(), name.size()));
+        snapshot->append(reinterpret_cast<const char*>(&section), sizeof(section));
+        snapshot->append(name);
+        snapshot->append(data);
+        snapshot->resize(base + align_up(snapshot->size() - base, 8), '\0');
+    }
+
+    header.snapshot_size = snapshot->size() - base;
+    memcpy(const_cast<char*>(snapshot->data()) + base, &header, sizeof(header));
+}
+
+int CSnapshotManager::save_to_memfd() const
+{
+    std::string snapshot;
+    save(&snapshot);
+
+    const int fd = memfd_create("mooon_snapshot", MFD_CLOEXEC);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "memfd_create");
+
+    try
+    {
+        write_fd(fd, snapshot, "memfd");
+    }
+    catch (CSyscallException&)
+    {
+        ::close(fd);
+        throw;
+    }
+    return fd;
+}
+
+void CSnapshotManager::save_to_file(const std::string& filepath) const
+{
+    std::string snapshot;
+    save(&snapshot);
+
+    const std::string tmp_filepath = filepath + ".tmp";
+    const int fd = ::open(tmp_filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("open %s error: %s", tmp_filepath.c_str(), strerror(errno)), errno, "open");
+
+    try
+    {
+        write_fd(fd, snapshot, tmp_filepath.c_str());
+        ::close(fd);
+    }
+    catch (CSyscallException&)
+    {
+        ::close(fd);
+        (void)unlink(tmp_filepath.c_str());
+        throw;
+    }
+    if (-1 == rename(tmp_filepath.c_str(), filepath.c_str()))
+    {
+        const int errcode = errno;
+        (void)unlink(tmp_filepath.c_str());
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("rename %s error: %s", tmp_filepath.c_str(), strerror(errcode)), errcode, "rename");
+    }
+}
+
+bool CSnapshotManager::adopt(int fd)
+{
+    mmap_t* ptr = NULL;
+    try
+    {
+        ptr = CMMap::map_read(fd);
+    }
+    catch (CSyscallException& ex)
+    {
+        MYLOG_ERROR("Map snapshot error: %s\n", ex.str().c_str());
+    }
+
+    ::close(fd);
+    return (ptr != NULL) && adopt_mapped(ptr);
+}
+
+bool CSnapshotManager::adopt_file(const std::string& filepath)
+{
+    const int fd = ::open(filepath.c_str(), O_RDONLY|O_CLOEXEC);
+    if (-1 == fd)
+    {
+        if (errno != ENOENT)
+            MYLOG_ERROR("Open snapshot %s error: %s\n", filepath.c_str(), strerror(errno));
+        return false;
+    }
+
+    (void)unlink(filepath.c_str());
+    return adopt(fd);
+}
+
+bool CSnapshotManager::adopt_mapped(mmap_t* ptr)
+{
+    const char* data = static_cast<const char*>(ptr->addr);
+    const size_t size = ptr->len;
+    snapshot_header_t header;
+
+    (void)release();
+    if ((NULL == data) || (size < sizeof(header)))
+    {
+        MYLOG_ERROR("Invalid snapshot of %zu bytes\n", size);
+        CMMap::unmap(ptr);
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if ((memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) || (header.version != SNAPSHOT_VERSION) ||
+        (header.snapshot_size != size))
+    {
+        MYLOG_ERROR("Invalid snapshot header\n");
+        CMMap::unmap(ptr);
+        return false;
+    }
+
+    // 只登记各段，校验在认领时进行
+    size_t offset = sizeof(header);
+    for (uint32_t i=0; i<header.section_number; ++i)
+    {
+        section_header_t section_header;
+        if (size - offset < sizeof(section_header))
+            break;
+        memcpy(&section_header, data+offset, sizeof(section_header));
+        offset += sizeof(section_header);
+        if ((section_header.name_size > size - offset) || (section_header.data_size > size - offset - section_header.name_size))
+            break;
+
+        Section section;
+        const std::string name(data+offset, section_header.name_size);
+        section.version = section_header.version;
+        section.checksum = section_header.checksum;
+        section.data = data + offset + section_header.name_size;
+        section.size = static_cast<size_t>(section_header.data_size);
+        _sections[name] = section;
+        offset = align_up(offset + section_header.name_size + section.size, 8);
+        if (offset > size)
+            break;
+    }
+    if (_sections.size() != header.section_number)
+    {
+        MYLOG_ERROR("Corrupted snapshot: %zu of %u sections\n", _sections.size(), header.section_number);
+        _sections.clear();
+        CMMap::unmap(ptr);
+        return false;
+    }
+
+    const uint64_t now = CDatetimeUtils::get_current_milliseconds();
+    _snapshot = ptr;
+    _elapsed_milliseconds = (now > header.saved_milliseconds)? now - header.saved_milliseconds: 0;
+    MYLOG_INFO("Adopted snapshot of %u sections saved %" PRIu64"ms ago\n", header.section_number, _elapsed_milliseconds);
+    return true;
+}
+
+uint32_t CSnapshotManager::release()
+{
+    const uint32_t unclaimed = static_cast<uint32_t>(_sections.size());
+    for (std::map<std::string, Section>::const_iterator iter=_sections.begin(); iter!=_sections.end(); ++iter)
+        MYLOG_WARN("Snapshot %s is not claimed\n", iter->first.c_str());
+    _sections.clear();
+
+    if (_snapshot != NULL)
+    {
+        CMMap::unmap(_snapshot);
+        _snapshot = NULL;
+    }
+    _elapsed_milliseconds = 0;
+    return unclaimed;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,122 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/spin_lock.h"
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 排队自旋锁自旋多少次后开始让出CPU，避免持有者被调度出去时空转整个时间片
+#define TICKET_LOCK_YIELD_SPINS 1000
+
+// 在线CPU个数，只取一次
+static long get_online_cpu_number()
+{
+    static long cpu_number = 0;
+    if (0 == __atomic_load_n(&cpu_number, __ATOMIC_RELAXED))
+        __atomic_store_n(&cpu_number, sysconf(_SC_NPROCESSORS_ONLN), __ATOMIC_RELAXED);
+    return __atomic_load_n(&cpu_number, __ATOMIC_RELAXED);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CAdaptiveLock
+
+CAdaptiveLock::CAdaptiveLock(uint32_t spin_number, bool enable_stat)
+    :_state(0)
+    ,_spin_number((get_online_cpu_number() > 1)? spin_number: 0) // 单CPU时持有者不可能同时在运行
+    ,_enable_stat(enable_stat)
+    ,_lock_number(0)
+    ,_contention_number(0)
+    ,_sleep_number(0)
+{
+}
+
+void CAdaptiveLock::lock_slow()
+{
+    bool slept = false;
+    bool acquired = false;
+
+    // 先自旋，持有者很快就会释放
+    for (uint32_t i=0; !acquired && (i<_spin_number); ++i)
+    {
+        SPIN_LOCK_PAUSE();
+        if (0 == __atomic_load_n(&_state, __ATOMIC_RELAXED))
+        {
+            int expected = 0;
+            acquired = __atomic_compare_exchange_n(&_state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+        }
+    }
+
+    // 置为2后睡眠，醒来后仍以2获取，因为不知道是否还有其它等待者
+    if (!acquired)
+    {
+        while (__atomic_exchange_n(&_state, 2, __ATOMIC_ACQUIRE) != 0)
+        {
+            slept = true;
+            (void)syscall(SYS_futex, &_state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+        }
+    }
+
+    // 已持有锁，以下更新不需要原子操作
+    if (_enable_stat)
+    {
+        ++_lock_number;
+        ++_contention_number;
+        if (slept)
+            ++_sleep_number;
+    }
+}
+
+void CAdaptiveLock::wake()
+{
+    (void)syscall(SYS_futex, &_state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CTicketLock
+
+CTicketLock::CTicketLock(bool enable_stat)
+    :_next_ticket(0)
+    ,_now_serving(0)
+    ,_yield_spins((get_online_cpu_number() > 1)? TICKET_LOCK_YIELD_SPINS: 0) // 单CPU时自旋无意义，直接让出
+    ,_enable_stat(enable_stat)
+    ,_lock_number(0)
+    ,_contention_number(0)
+{
+}
+
+void CTicketLock::wait(uint32_t ticket)
+{
+    for (uint32_t i=1; __atomic_load_n(&_now_serving, __ATOMIC_ACQUIRE) != ticket; ++i)
+    {
+        if (i < _yield_spins)
+            SPIN_LOCK_PAUSE();
+        else
+            sched_yield();
+    }
+
+    if (_enable_stat)
+    {
+        ++_lock_number;
+        ++_contention_number;
+    }
+}
+
+SYS_NAMESPACE_END
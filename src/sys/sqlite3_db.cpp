@@ -30,8 +30,39 @@ SYS_NAMESPACE_BEGIN
 // 将自己注释到CObjectFactdory中
 REGISTER_OBJECT_CREATOR("sqlite3_connection", CSQLite3Connection)
 
+// 用完后归还语句：缓存的reset后留在缓存中，未缓存的finalize
+class CStatementGuard
+{
+public:
+    CStatementGuard(sqlite3_stmt* stmt, bool cached)
+        : _stmt(stmt), _cached(cached)
+    {
+    }
+
+    ~CStatementGuard()
+    {
+        if (_stmt != NULL)
+        {
+            if (_cached)
+            {
+                (void)sqlite3_reset(_stmt);
+                (void)sqlite3_clear_bindings(_stmt);
+            }
+            else
+            {
+                (void)sqlite3_finalize(_stmt);
+            }
+        }
+    }
+
+private:
+    sqlite3_stmt* _stmt;
+    bool _cached;
+};
+
 CSQLite3Connection::CSQLite3Connection(size_t sql_max)
-    : CDBConnectionBase(sql_max), _sqlite(NULL)
+    : CDBConnectionBase(sql_max), _sqlite(NULL), _autocommit(true),
+      _mmap_size(-1), _busy_timeout_milliseconds(0), _statement_cache_size(64)
 {
 }
 
@@ -62,6 +93,23 @@ void CSQLite3Connection::open()
         }
 
         _sqlite = sqlite;
+        try
+        {
+            if (_busy_timeout_milliseconds > 0)
+                (void)sqlite3_busy_timeout(sqlite, _busy_timeout_milliseconds);
+            pragma("journal_mode", _journal_mode);
+            pragma("synchronous", _synchronous);
+            if (_mmap_size >= 0)
+                pragma("mmap_size", utils::CStringUtils::int_tostring(_mmap_size));
+        }
+        catch (CDBException&)
+        {
+            close();
+            throw;
+        }
+
+        _autocommit = true;
+        _is_established = true;
     }
 }
 
@@ -73,6 +121,8 @@ void CSQLite3Connection::close() throw ()
     {
         sqlite3* sqlite = static_cast<sqlite3*>(_sqlite);
 
+        // 语句须在连接关闭之前释放，否则sqlite3_close返回SQLITE_BUSY
+        clear_statements();
         sqlite3_close(sqlite);
         _sqlite = NULL;
     }
@@ -116,17 +166,192 @@ uint64_t CSQLite3Connection::update(const char* format, ...)
         sql.reset(new char[sql_size]);
     }
 
-    ret = sqlite3_exec(sqlite, sql.get(), 0, 0, &errmsg);
+    bool cached = false;
+    sqlite3_stmt* stmt = static_cast<sqlite3_stmt*>(prepare(sql.get(), excepted, &cached));
+    if (stmt != NULL)
+    {
+        CStatementGuard guard(stmt, cached);
+        while (SQLITE_ROW == (ret = sqlite3_step(stmt)));
+        if (ret != SQLITE_DONE)
+        {
+            throw CDBException(sql.get(), utils::StringFormatter("sql[%s] error: %s", sql.get(), sqlite3_errmsg(sqlite)).c_str(),
+                    ret, __FILE__, __LINE__);
+        }
+    }
+    else
+    {
+        // 多条语句
+        ret = sqlite3_exec(sqlite, sql.get(), 0, 0, &errmsg);
+        if (ret != SQLITE_OK)
+        {
+            std::string errmsg_ = errmsg;
+            sqlite3_free(errmsg);
+
+            throw CDBException(sql.get(), utils::StringFormatter("sql[%s] error: %s", sql.get(), errmsg_.c_str()).c_str(),
+                    ret, __FILE__, __LINE__);
+        }
+    }
+
+    return static_cast<uint64_t>(sqlite3_changes(sqlite));
+}
+
+uint64_t CSQLite3Connection::execute(const std::string& sql, const DBRow& params)
+{
+    MOOON_ASSERT(_sqlite != NULL);
+
+    sqlite3* sqlite = static_cast<sqlite3*>(_sqlite);
+    bool cached = false;
+    sqlite3_stmt* stmt = static_cast<sqlite3_stmt*>(prepare(sql.c_str(), static_cast<int>(sql.size()), &cached));
+    if (NULL == stmt)
+    {
+        throw CDBException(sql.c_str(), "only single statement is supported by execute", DB_NOT_SUPPORTED, __FILE__, __LINE__);
+    }
+
+    CStatementGuard guard(stmt, cached);
+    if (static_cast<int>(params.size()) != sqlite3_bind_parameter_count(stmt))
+    {
+        throw CDBException(sql.c_str(),
+                utils::StringFormatter("sql[%s] error: %d params expected, but %d given", sql.c_str(),
+                        sqlite3_bind_parameter_count(stmt), static_cast<int>(params.size())).c_str(),
+                SQLITE_RANGE, __FILE__, __LINE__);
+    }
+    for (DBRow::size_type i=0; i<params.size(); ++i)
+    {
+        // 参数在step期间引用调用者的字符串，不复制
+        const int ret = sqlite3_bind_text(stmt, static_cast<int>(i+1), params[i].data(), static_cast<int>(params[i].size()), SQLITE_STATIC);
+        if (ret != SQLITE_OK)
+        {
+            throw CDBException(sql.c_str(), utils::StringFormatter("sql[%s] bind error: %s", sql.c_str(), sqlite3_errmsg(sqlite)).c_str(),
+                    ret, __FILE__, __LINE__);
+        }
+    }
+
+    int ret;
+    while (SQLITE_ROW == (ret = sqlite3_step(stmt)));
+    if (ret != SQLITE_DONE)
+    {
+        throw CDBException(sql.c_str(), utils::StringFormatter("sql[%s] error: %s", sql.c_str(), sqlite3_errmsg(sqlite)).c_str(),
+                ret, __FILE__, __LINE__);
+    }
+
+    return static_cast<uint64_t>(sqlite3_changes(sqlite));
+}
+
+void CSQLite3Connection::commit()
+{
+    if (!_autocommit)
+    {
+        exec("COMMIT");
+        exec("BEGIN");
+    }
+}
+
+void CSQLite3Connection::rollback()
+{
+    if (!_autocommit)
+    {
+        exec("ROLLBACK");
+        exec("BEGIN");
+    }
+}
+
+void CSQLite3Connection::enable_autocommit(bool enabled)
+{
+    if (enabled != _autocommit)
+    {
+        exec(enabled? "COMMIT": "BEGIN");
+        _autocommit = enabled;
+    }
+}
+
+void CSQLite3Connection::exec(const char* sql)
+{
+    MOOON_ASSERT(_sqlite != NULL);
+
+    sqlite3* sqlite = static_cast<sqlite3*>(_sqlite);
+    char* errmsg = NULL;
+    const int ret = sqlite3_exec(sqlite, sql, 0, 0, &errmsg);
     if (ret != SQLITE_OK)
     {
-        std::string errmsg_ = errmsg;
+        std::string errmsg_ = (errmsg != NULL)? errmsg: sqlite3_errmsg(sqlite);
         sqlite3_free(errmsg);
 
-        throw CDBException(sql.get(), utils::StringFormatter("sql[%s] error: %s", sql.get(), errmsg_.c_str()).c_str(),
+        throw CDBException(sql, utils::StringFormatter("sql[%s] error: %s", sql, errmsg_.c_str()).c_str(),
                 ret, __FILE__, __LINE__);
     }
+}
 
-    return static_cast<uint64_t>(ret);
+void CSQLite3Connection::pragma(const char* name, const std::string& value)
+{
+    if (!value.empty())
+    {
+        const std::string sql = utils::CStringUtils::format_string("PRAGMA %s=%s", name, value.c_str());
+        exec(sql.c_str());
+    }
+}
+
+void* CSQLite3Connection::prepare(const char* sql, int sql_length, bool* cached)
+{
+    sqlite3* sqlite = static_cast<sqlite3*>(_sqlite);
+    const std::string key(sql, sql_length);
+    std::map<std::string, statement_list_t::iterator>::iterator iter = _statement_index.find(key);
+
+    *cached = false;
+    if (iter != _statement_index.end())
+    {
+        // 移到最前
+        _statements.splice(_statements.begin(), _statements, iter->second);
+        *cached = true;
+        return iter->second->second;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    const char* tail = NULL;
+    const int ret = sqlite3_prepare_v2(sqlite, sql, sql_length, &stmt, &tail);
+    if (ret != SQLITE_OK)
+    {
+        throw CDBException(sql,
+                utils::StringFormatter("sql[%s] error: %s", key.c_str(), sqlite3_errmsg(sqlite)).c_str(),
+                ret, __FILE__, __LINE__);
+    }
+
+    // 第一条语句之后还有非空白内容
+    for (; (tail != NULL) && (tail < sql+sql_length); ++tail)
+    {
+        if ((*tail != ' ') && (*tail != '\t') && (*tail != '\r') && (*tail != '\n') && (*tail != ';'))
+        {
+            (void)sqlite3_finalize(stmt);
+            return NULL;
+        }
+    }
+    if (NULL == stmt) // 只有空白或注释，也交给sqlite3_exec
+    {
+        return NULL;
+    }
+
+    if (_statement_cache_size > 0)
+    {
+        if (_statements.size() >= _statement_cache_size)
+        {
+            (void)sqlite3_finalize(static_cast<sqlite3_stmt*>(_statements.back().second));
+            _statement_index.erase(_statements.back().first);
+            _statements.pop_back();
+        }
+
+        _statements.push_front(std::make_pair(key, static_cast<void*>(stmt)));
+        _statement_index[key] = _statements.begin();
+        *cached = true;
+    }
+
+    return stmt;
+}
+
+void CSQLite3Connection::clear_statements()
+{
+    for (statement_list_t::iterator iter=_statements.begin(); iter!=_statements.end(); ++iter)
+        (void)sqlite3_finalize(static_cast<sqlite3_stmt*>(iter->second));
+    _statements.clear();
+    _statement_index.clear();
 }
 
 std::string CSQLite3Connection::str() throw ()
@@ -139,6 +364,43 @@ void CSQLite3Connection::do_query(DBTable& db_table, const char* sql, int sql_le
     MOOON_ASSERT(_sqlite != NULL);
 
     sqlite3* sqlite = static_cast<sqlite3*>(_sqlite);
+    bool cached = false;
+    sqlite3_stmt* stmt = static_cast<sqlite3_stmt*>(prepare(sql, sql_length, &cached));
+    if (stmt != NULL)
+    {
+        CStatementGuard guard(stmt, cached);
+        const int num_cols = sqlite3_column_count(stmt);
+        int ret;
+
+        while (SQLITE_ROW == (ret = sqlite3_step(stmt)))
+        {
+            db_table.push_back(DBRow());
+            DBRow& db_row = db_table.back();
+            db_row.reserve(num_cols);
+            for (int col=0; col<num_cols; ++col)
+            {
+                if (SQLITE_NULL == sqlite3_column_type(stmt, col))
+                {
+                    db_row.push_back(_null_value);
+                }
+                else
+                {
+                    // 须先取sqlite3_column_text，再取sqlite3_column_bytes
+                    const char* field_value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+                    db_row.push_back(std::string(field_value, sqlite3_column_bytes(stmt, col)));
+                }
+            }
+        }
+        if (ret != SQLITE_DONE)
+        {
+            throw CDBException(sql,
+                    utils::StringFormatter("sql[%s] error: %s", sql, sqlite3_errmsg(sqlite)).c_str(),
+                    ret, __FILE__, __LINE__);
+        }
+        return;
+    }
+
+    // 多条语句
     char *errmsg = NULL;
     char **table = NULL;
     int num_rows = 0;
@@ -184,5 +446,142 @@ void CSQLite3Connection::do_query(DBTable& db_table, const char* sql, int sql_le
     }
 }
 
+// sqlite3_step方式的游标
+class CSQLite3Cursor: public DBCursor
+{
+public:
+    CSQLite3Cursor(sqlite3* sqlite, sqlite3_stmt* stmt, const std::string& null_value)
+        : _sqlite(sqlite), _stmt(stmt), _null_value(null_value)
+    {
+        _fields.resize(sqlite3_column_count(stmt));
+    }
+
+    ~CSQLite3Cursor()
+    {
+        (void)sqlite3_finalize(_stmt);
+    }
+
+private:
+    virtual bool fetch()
+    {
+        const int ret = sqlite3_step(_stmt);
+        if (SQLITE_DONE == ret)
+            return false;
+        if (ret != SQLITE_ROW)
+        {
+            throw CDBException(sqlite3_sql(_stmt),
+                    utils::StringFormatter("step error: %s", sqlite3_errmsg(_sqlite)).c_str(),
+                    ret, __FILE__, __LINE__);
+        }
+
+        for (std::vector<DBField>::size_type i=0; i<_fields.size(); ++i)
+        {
+            DBField& field = _fields[i];
+            const int col = static_cast<int>(i);
+
+            field.is_null = (SQLITE_NULL == sqlite3_column_type(_stmt, col));
+            if (field.is_null)
+            {
+                field.data = _null_value.data();
+                field.size = _null_value.size();
+            }
+            else
+            {
+                // 须先取sqlite3_column_text，再取sqlite3_column_bytes
+                field.data = reinterpret_cast<const char*>(sqlite3_column_text(_stmt, col));
+                field.size = static_cast<size_t>(sqlite3_column_bytes(_stmt, col));
+            }
+        }
+
+        return true;
+    }
+
+private:
+    sqlite3* _sqlite;
+    sqlite3_stmt* _stmt;
+    const std::string _null_value;
+};
+
+DBCursor* CSQLite3Connection::do_open_cursor(const char* sql, int sql_length)
+{
+    MOOON_ASSERT(_sqlite != NULL);
+
+    sqlite3* sqlite = static_cast<sqlite3*>(_sqlite);
+    sqlite3_stmt* stmt = NULL;
+    const int ret = sqlite3_prepare_v2(sqlite, sql, sql_length, &stmt, NULL);
+    if (ret != SQLITE_OK)
+    {
+        throw CDBException(sql,
+                utils::StringFormatter("sql[%s] error: %s", sql, sqlite3_errmsg(sqlite)).c_str(),
+                ret, __FILE__, __LINE__);
+    }
+
+    return new CSQLite3Cursor(sqlite, stmt, _null_value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CSQLite3BatchWriter::CSQLite3BatchWriter(CSQLite3Connection* sqlite, uint32_t max_updates)
+    : _sqlite(sqlite), _max_updates((0 == max_updates)? 1: max_updates),
+      _pending_number(0), _commit_number(0)
+{
+}
+
+CSQLite3BatchWriter::~CSQLite3BatchWriter()
+{
+    try
+    {
+        flush();
+    }
+    catch (CDBException&)
+    {
+        try
+        {
+            _sqlite->rollback();
+            _sqlite->enable_autocommit(true);
+        }
+        catch (CDBException&)
+        {
+        }
+    }
+}
+
+uint64_t CSQLite3BatchWriter::execute(const std::string& sql, const DBRow& params)
+{
+    if (0 == _pending_number)
+        _sqlite->enable_autocommit(false);
+
+    try
+    {
+        const uint64_t changes = _sqlite->execute(sql, params);
+        if (++_pending_number >= _max_updates)
+            flush();
+        return changes;
+    }
+    catch (CDBException&)
+    {
+        // 回滚整个未提交的事务，连接回到自动提交状态
+        _pending_number = 0;
+        try
+        {
+            _sqlite->rollback();
+            _sqlite->enable_autocommit(true);
+        }
+        catch (CDBException&)
+        {
+        }
+        throw;
+    }
+}
+
+void CSQLite3BatchWriter::flush()
+{
+    if (_pending_number > 0)
+    {
+        _pending_number = 0;
+        _sqlite->enable_autocommit(true); // 提交
+        ++_commit_number;
+    }
+}
+
 SYS_NAMESPACE_END
 #endif // MOOON_HAVE_SQLITE3
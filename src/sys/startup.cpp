@@ -0,0 +1,341 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/startup.h"
+#include "sys/clock.h"
+#include "sys/syscall_exception.h"
+#include "sys/thread_engine.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include "utils/tokener.h"
+#include <algorithm>
+#include <errno.h>
+#include <inttypes.h>
+#include <map>
+#include <stdexcept>
+SYS_NAMESPACE_BEGIN
+
+// 按开始时间排序
+struct StartupPhaseStartLess
+{
+    bool operator ()(const startup_phase_t& lhs, const startup_phase_t& rhs) const
+    {
+        return lhs.start_milliseconds < rhs.start_milliseconds;
+    }
+};
+
+// 按耗时从大到小排序
+struct StartupPhaseDurationGreater
+{
+    bool operator ()(const startup_phase_t& lhs, const startup_phase_t& rhs) const
+    {
+        return lhs.duration_milliseconds > rhs.duration_milliseconds;
+    }
+};
+
+CStartupProfiler::CStartupProfiler()
+    : _start_milliseconds(CClock::get_milliseconds())
+{
+}
+
+void CStartupProfiler::add_phase(const std::string& name, uint64_t start_milliseconds, uint64_t end_milliseconds)
+{
+    startup_phase_t phase;
+    phase.name = name;
+    phase.start_milliseconds = (start_milliseconds > _start_milliseconds)? start_milliseconds - _start_milliseconds: 0;
+    phase.duration_milliseconds = (end_milliseconds > start_milliseconds)? end_milliseconds - start_milliseconds: 0;
+
+    LockHelper<CLock> lock_helper(_lock);
+    _phases.push_back(phase);
+}
+
+std::vector<startup_phase_t> CStartupProfiler::get_phases() const
+{
+    std::vector<startup_phase_t> phases;
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        phases = _phases;
+    }
+
+    std::stable_sort(phases.begin(), phases.end(), StartupPhaseStartLess());
+    return phases;
+}
+
+uint64_t CStartupProfiler::get_elapsed_milliseconds() const
+{
+    return CClock::get_milliseconds() - _start_milliseconds;
+}
+
+std::string CStartupProfiler::to_string() const
+{
+    std::vector<startup_phase_t> phases = get_phases();
+    std::string str = utils::CStringUtils::format_string("total %" PRIu64"ms", get_elapsed_milliseconds());
+
+    std::stable_sort(phases.begin(), phases.end(), StartupPhaseDurationGreater());
+    for (std::vector<startup_phase_t>::size_type i=0; i<phases.size(); ++i)
+    {
+        str += (0 == i)? ": ": ", ";
+        str += utils::CStringUtils::format_string("%s %" PRIu64"ms@%" PRIu64,
+                phases[i].name.c_str(), phases[i].duration_milliseconds, phases[i].start_milliseconds);
+    }
+    return str;
+}
+
+CStartupPhase::CStartupPhase(CStartupProfiler* profiler, const std::string& name)
+    : _profiler(profiler), _name(name), _start_milliseconds(CClock::get_milliseconds())
+{
+}
+
+CStartupPhase::~CStartupPhase()
+{
+    if (_profiler != NULL)
+        _profiler->add_phase(_name, _start_milliseconds, CClock::get_milliseconds());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CParallelInitializer::CParallelInitializer()
+    : _profiler(NULL), _running_number(0), _finished_number(0), _failed(false)
+{
+}
+
+CParallelInitializer::~CParallelInitializer()
+{
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+        delete _tasks[i];
+}
+
+void CParallelInitializer::add_task(const std::string& name, utils::Functor<bool> task, const std::string& dependencies)
+{
+    if (name.empty())
+        THROW_EXCEPTION("empty init task name", EINVAL);
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+    {
+        if (_tasks[i]->name == name)
+            THROW_EXCEPTION(utils::CStringUtils::format_string("init task %s exists", name.c_str()), EEXIST);
+    }
+
+    Task* new_task = new Task;
+    new_task->name = name;
+    new_task->function = task;
+    new_task->pending_number = 0;
+    new_task->finish_milliseconds = 0;
+    new_task->critical_dependency = NULL;
+    std::vector<std::string> names;
+    (void)utils::CTokener::split(&names, dependencies, ",", true);
+    for (std::vector<std::string>::size_type i=0; i<names.size(); ++i)
+    {
+        const std::string dependency_name = utils::CStringUtils::trim(static_cast<const std::string&>(names[i]));
+        if (!dependency_name.empty())
+            new_task->dependency_names.push_back(dependency_name);
+    }
+    _tasks.push_back(new_task);
+}
+
+bool CParallelInitializer::run(uint16_t thread_number, CStartupProfiler* profiler)
+{
+    resolve_dependencies();
+    if (_tasks.empty())
+        return true;
+
+    _profiler = profiler;
+    _error.clear();
+    _running_number = 0;
+    _finished_number = 0;
+    _failed = false;
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+    {
+        if (0 == _tasks[i]->pending_number)
+            _ready_tasks.push_back(_tasks[i]);
+    }
+
+    // 调用者线程也执行任务，所以少创建一个线程
+    const uint32_t number = ((0 == thread_number) || (thread_number > _tasks.size()))? static_cast<uint32_t>(_tasks.size()): thread_number;
+    std::vector<CThreadEngine*> threads;
+    try
+    {
+        for (uint32_t i=1; i<number; ++i)
+            threads.push_back(new CThreadEngine(bind(&CParallelInitializer::work, this)));
+    }
+    catch (CSyscallException&)
+    {
+        // 已启动的任务执行完后再抛出
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            _failed = true;
+        }
+        for (std::vector<CThreadEngine*>::size_type i=0; i<threads.size(); ++i)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+        _ready_tasks.clear();
+        throw;
+    }
+
+    work();
+    for (std::vector<CThreadEngine*>::size_type i=0; i<threads.size(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    _ready_tasks.clear();
+    return !_failed;
+}
+
+std::string CParallelInitializer::get_critical_path() const
+{
+    const Task* last = NULL;
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+    {
+        if ((NULL == last) || (_tasks[i]->finish_milliseconds > last->finish_milliseconds))
+            last = _tasks[i];
+    }
+
+    std::string path;
+    for (const Task* task=last; task!=NULL; task=task->critical_dependency)
+        path = path.empty()? task->name: task->name + " -> " + path;
+    return path;
+}
+
+void CParallelInitializer::resolve_dependencies()
+{
+    std::map<std::string, Task*> task_table;
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+    {
+        _tasks[i]->dependents.clear();
+        _tasks[i]->pending_number = 0;
+        _tasks[i]->finish_milliseconds = 0;
+        _tasks[i]->critical_dependency = NULL;
+        task_table[_tasks[i]->name] = _tasks[i];
+    }
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+    {
+        Task* task = _tasks[i];
+        for (std::vector<std::string>::size_type j=0; j<task->dependency_names.size(); ++j)
+        {
+            std::map<std::string, Task*>::iterator iter = task_table.find(task->dependency_names[j]);
+            if (iter == task_table.end())
+                THROW_EXCEPTION(utils::CStringUtils::format_string("init task %s depends on unknown %s", task->name.c_str(), task->dependency_names[j].c_str()), EINVAL);
+
+            iter->second->dependents.push_back(task);
+            ++task->pending_number;
+        }
+    }
+
+    // 按拓扑顺序消去，剩下的在环中
+    std::map<Task*, uint32_t> pending_table;
+    std::vector<Task*> ready_tasks;
+    for (std::vector<Task*>::size_type i=0; i<_tasks.size(); ++i)
+    {
+        pending_table[_tasks[i]] = _tasks[i]->pending_number;
+        if (0 == _tasks[i]->pending_number)
+            ready_tasks.push_back(_tasks[i]);
+    }
+    for (std::vector<Task*>::size_type i=0; i<ready_tasks.size(); ++i)
+    {
+        for (std::vector<Task*>::size_type j=0; j<ready_tasks[i]->dependents.size(); ++j)
+        {
+            if (0 == --pending_table[ready_tasks[i]->dependents[j]])
+                ready_tasks.push_back(ready_tasks[i]->dependents[j]);
+        }
+    }
+    if (ready_tasks.size() != _tasks.size())
+    {
+        std::string names;
+        for (std::map<Task*, uint32_t>::const_iterator iter=pending_table.begin(); iter!=pending_table.end(); ++iter)
+        {
+            if (iter->second > 0)
+                names += names.empty()? iter->first->name: "," + iter->first->name;
+        }
+        THROW_EXCEPTION(utils::CStringUtils::format_string("init tasks %s have circular dependencies", names.c_str()), EINVAL);
+    }
+}
+
+void CParallelInitializer::work()
+{
+    _lock.lock();
+    while (true)
+    {
+        if (_failed || _ready_tasks.empty())
+        {
+            // 没有可执行的任务，也没有在执行的任务，则已全部完成或已失败
+            if (_failed || (0 == _running_number))
+                break;
+            _event.wait(_lock);
+            continue;
+        }
+
+        Task* task = _ready_tasks.back();
+        std::string errmsg;
+        _ready_tasks.pop_back();
+        ++_running_number;
+        _lock.unlock();
+        const bool ok = execute(task, &errmsg);
+        _lock.lock();
+
+        --_running_number;
+        ++_finished_number;
+        if (!ok)
+        {
+            if (!_failed)
+                _error = errmsg;
+            _failed = true;
+        }
+        else
+        {
+            // 完成的顺序即时间顺序，最后一个使依赖数减为0的即最后完成的依赖
+            for (std::vector<Task*>::size_type i=0; i<task->dependents.size(); ++i)
+            {
+                Task* dependent = task->dependents[i];
+                dependent->critical_dependency = task;
+                if (0 == --dependent->pending_number)
+                    _ready_tasks.push_back(dependent);
+            }
+        }
+        _event.broadcast();
+    }
+    _lock.unlock();
+}
+
+bool CParallelInitializer::execute(Task* task, std::string* errmsg)
+{
+    const uint64_t start_milliseconds = CClock::get_milliseconds();
+    bool ok = false;
+
+    try
+    {
+        ok = task->function();
+        if (!ok)
+            *errmsg = utils::CStringUtils::format_string("init task %s failed", task->name.c_str());
+    }
+    catch (utils::CException& ex)
+    {
+        *errmsg = utils::CStringUtils::format_string("init task %s failed: %s", task->name.c_str(), ex.str().c_str());
+    }
+    catch (std::exception& ex)
+    {
+        *errmsg = utils::CStringUtils::format_string("init task %s failed: %s", task->name.c_str(), ex.what());
+    }
+
+    task->finish_milliseconds = CClock::get_milliseconds();
+    if (_profiler != NULL)
+        _profiler->add_phase("init." + task->name, start_milliseconds, task->finish_milliseconds);
+    return ok;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,430 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/static_hash_table.h"
+#include "sys/syscall_exception.h"
+#include "utils/hash_utils.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+static const char TABLE_MAGIC[8] = { 'M', 'O', 'O', 'O', 'N', 'H', 'T', '1' };
+static const uint32_t TABLE_VERSION = 1;
+static const uint32_t MAX_PILOT = 1000000; // 一个桶试这么多个位移都放不下时，换种子重来
+static const int MAX_SEED_TRIES = 32;
+static const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+// 哈希表的头部
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t key_number;
+    uint64_t bucket_number;
+    uint64_t slot_number;
+    uint64_t records_offset;
+    uint64_t table_size;
+}table_header_t;
+
+static size_t align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t get_slots_offset(uint64_t bucket_number)
+{
+    return align_up(sizeof(table_header_t) + bucket_number * sizeof(uint32_t), 8);
+}
+
+// 同一个桶中的键哈希不同，位移混合后各自落到独立的槽
+static inline uint64_t get_slot_index(uint64_t hash, uint32_t pilot, uint64_t slot_number)
+{
+    return utils::CHashUtils::mix64(hash ^ utils::CHashUtils::mix64(pilot)) % slot_number;
+}
+
+static void write_data(int fd, const void* data, size_t size, const std::string& filepath)
+{
+    const char* p = static_cast<const char*>(data);
+    size_t written = 0;
+    while (written < size)
+    {
+        const ssize_t bytes = ::write(fd, p+written, size-written);
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("write %s error: %s", filepath.c_str(), strerror(errno)), errno, "write");
+        }
+
+        written += static_cast<size_t>(bytes);
+    }
+}
+
+CStaticHashTable::CStaticHashTable()
+    : _table(NULL), _size(0), _seed(0), _key_number(0), _bucket_number(0), _slot_number(0),
+      _pilots(NULL), _slots(NULL), _mmap(NULL)
+{
+}
+
+CStaticHashTable::~CStaticHashTable()
+{
+    close();
+}
+
+void CStaticHashTable::open(const void* data, size_t size)
+{
+    table_header_t header;
+    const char* table = static_cast<const char*>(data);
+
+    close();
+    if (size < sizeof(header))
+        THROW_EXCEPTION("static hash table too small", EINVAL);
+    memcpy(&header, table, sizeof(header));
+    if (memcmp(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0)
+        THROW_EXCEPTION("invalid static hash table magic", EINVAL);
+    if (header.version != TABLE_VERSION)
+        THROW_EXCEPTION(utils::CStringUtils::format_string("unsupported static hash table version: %u", header.version), EINVAL);
+    if ((reinterpret_cast<uintptr_t>(table) % 8) != 0)
+        THROW_EXCEPTION("static hash table not aligned to 8 bytes", EINVAL);
+
+    // 只校验头部和各区的边界，不扫描槽和记录，打开的耗时和文件大小无关，
+    // 记录的偏移在find时检查
+    if ((header.table_size > size) || (0 == header.bucket_number) || (0 == header.slot_number) ||
+        (header.bucket_number > size / sizeof(uint32_t)) || (header.slot_number > size / sizeof(static_hash_slot_t)) ||
+        (header.key_number > header.slot_number) ||
+        (header.records_offset != get_slots_offset(header.bucket_number) + header.slot_number * sizeof(static_hash_slot_t)) ||
+        (header.records_offset > header.table_size))
+        THROW_EXCEPTION("corrupted static hash table header", EINVAL);
+
+    _table = table;
+    _size = static_cast<size_t>(header.table_size);
+    _seed = header.seed;
+    _key_number = header.key_number;
+    _bucket_number = header.bucket_number;
+    _slot_number = header.slot_number;
+    _pilots = reinterpret_cast<const uint32_t*>(table + sizeof(header));
+    _slots = reinterpret_cast<const static_hash_slot_t*>(table + get_slots_offset(header.bucket_number));
+}
+
+void CStaticHashTable::open_file(const std::string& filepath, bool populate)
+{
+    close();
+
+    mmap_t* ptr = CMMap::map_read(filepath.c_str(), 0, populate? MAP_POPULATE: 0);
+    try
+    {
+        if ((NULL == ptr->addr) || (ptr->len < sizeof(table_header_t)))
+            THROW_EXCEPTION(utils::CStringUtils::format_string("%s is not a static hash table", filepath.c_str()), EINVAL);
+
+        // 查找是随机访问，预读只会换入用不到的页
+        if (!populate)
+            CMMap::advise(ptr, MADV_RANDOM);
+        open(ptr->addr, ptr->len);
+        _mmap = ptr;
+    }
+    catch (...)
+    {
+        CMMap::unmap(ptr);
+        throw;
+    }
+}
+
+void CStaticHashTable::close()
+{
+    if (_mmap != NULL)
+    {
+        CMMap::unmap(_mmap);
+        _mmap = NULL;
+    }
+
+    _table = NULL;
+    _size = 0;
+    _seed = 0;
+    _key_number = 0;
+    _bucket_number = 0;
+    _slot_number = 0;
+    _pilots = NULL;
+    _slots = NULL;
+}
+
+bool CStaticHashTable::find(std::string_view key, std::string_view* value) const
+{
+    if (NULL == _table)
+        return false;
+
+    const uint64_t hash = utils::CHashUtils::xxhash64(key.data(), key.size(), _seed);
+    const uint32_t pilot = _pilots[hash % _bucket_number];
+    const static_hash_slot_t& slot = _slots[get_slot_index(hash, pilot, _slot_number)];
+    if ((0 == slot.record_offset) || (slot.fingerprint != static_cast<uint32_t>(hash >> 32)) || (slot.key_size != key.size()))
+        return false;
+    if ((slot.record_offset < sizeof(table_header_t)) || (slot.record_offset > _size - RECORD_HEADER_SIZE))
+        THROW_EXCEPTION(utils::CStringUtils::format_string("corrupted static hash table slot: %" PRIu64, slot.record_offset), EINVAL);
+
+    uint32_t sizes[2]; // 键长度和值长度
+    const char* record = _table + slot.record_offset;
+    memcpy(sizes, record, sizeof(sizes));
+    if ((sizes[0] != slot.key_size) ||
+        (static_cast<uint64_t>(sizes[0]) + sizes[1] > _size - slot.record_offset - RECORD_HEADER_SIZE))
+        THROW_EXCEPTION(utils::CStringUtils::format_string("corrupted static hash table record: %" PRIu64, slot.record_offset), EINVAL);
+    if (memcmp(record+RECORD_HEADER_SIZE, key.data(), key.size()) != 0)
+        return false;
+
+    if (value != NULL)
+        *value = std::string_view(record+RECORD_HEADER_SIZE+sizes[0], sizes[1]);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct StaticHashBucket
+{
+    uint64_t index;
+    uint64_t start; // 在按桶排序的键中的下标
+    uint32_t size;
+};
+
+// 按桶和哈希排序，相同哈希的键相邻
+struct StaticHashKeyOrder
+{
+    const std::vector<uint64_t>& hashes;
+    const uint64_t bucket_number;
+
+    StaticHashKeyOrder(const std::vector<uint64_t>& hashes_, uint64_t bucket_number_)
+        : hashes(hashes_), bucket_number(bucket_number_)
+    {
+    }
+
+    bool operator ()(uint64_t lhs, uint64_t rhs) const
+    {
+        const uint64_t lhs_bucket = hashes[lhs] % bucket_number;
+        const uint64_t rhs_bucket = hashes[rhs] % bucket_number;
+        return (lhs_bucket < rhs_bucket) || ((lhs_bucket == rhs_bucket) && (hashes[lhs] < hashes[rhs]));
+    }
+};
+
+// 大的桶先放：越往后空槽越少，小的桶更容易找到位移
+struct StaticHashBucketOrder
+{
+    bool operator ()(const StaticHashBucket& lhs, const StaticHashBucket& rhs) const
+    {
+        return lhs.size > rhs.size;
+    }
+};
+
+// 为每个桶找位移，使所有键落到不同的槽，找不到时返回false
+// @order: 按StaticHashKeyOrder排好的键下标
+// @slot_keys: 输出参数，每个槽的键下标加1，0表示空槽
+static bool find_pilots(const std::vector<uint64_t>& hashes, const std::vector<uint64_t>& order,
+                        uint64_t bucket_number, uint64_t slot_number,
+                        std::vector<uint32_t>* pilots, std::vector<uint64_t>* slot_keys)
+{
+    std::vector<StaticHashBucket> buckets;
+    for (uint64_t i=0; i<order.size(); )
+    {
+        StaticHashBucket bucket;
+        bucket.index = hashes[order[i]] % bucket_number;
+        bucket.start = i;
+        for (++i; (i < order.size()) && (hashes[order[i]] % bucket_number == bucket.index); ++i);
+        bucket.size = static_cast<uint32_t>(i - bucket.start);
+        buckets.push_back(bucket);
+    }
+    std::stable_sort(buckets.begin(), buckets.end(), StaticHashBucketOrder());
+
+    std::vector<bool> taken(slot_number, false);
+    std::vector<uint64_t> positions;
+    pilots->assign(bucket_number, 0);
+    slot_keys->assign(slot_number, 0);
+    for (std::vector<StaticHashBucket>::size_type i=0; i<buckets.size(); ++i)
+    {
+        const StaticHashBucket& bucket = buckets[i];
+        uint32_t pilot = 0;
+
+        for (; pilot<MAX_PILOT; ++pilot)
+        {
+            positions.clear();
+            for (uint32_t j=0; j<bucket.size; ++j)
+            {
+                const uint64_t position = get_slot_index(hashes[order[bucket.start+j]], pilot, slot_number);
+                if (taken[position] || (std::find(positions.begin(), positions.end(), position) != positions.end()))
+                    break;
+                positions.push_back(position);
+            }
+            if (positions.size() == bucket.size)
+                break;
+        }
+        if (MAX_PILOT == pilot)
+            return false;
+
+        (*pilots)[bucket.index] = pilot;
+        for (uint32_t j=0; j<bucket.size; ++j)
+        {
+            taken[positions[j]] = true;
+            (*slot_keys)[positions[j]] = order[bucket.start+j] + 1;
+        }
+    }
+
+    return true;
+}
+
+CStaticHashTableWriter::CStaticHashTableWriter()
+{
+}
+
+void CStaticHashTableWriter::add(std::string_view key, std::string_view value)
+{
+    if ((key.size() > 0xFFFFFFFFU) || (value.size() > 0xFFFFFFFFU))
+        THROW_EXCEPTION("key or value of static hash table too large", EINVAL);
+
+    Record record;
+    record.offset = _data.size();
+    record.key_size = static_cast<uint32_t>(key.size());
+    record.value_size = static_cast<uint32_t>(value.size());
+    _data.append(key.data(), key.size());
+    _data.append(value.data(), value.size());
+    _records.push_back(record);
+}
+
+void CStaticHashTableWriter::write_file(const std::string& filepath) const
+{
+    const uint64_t key_number = static_cast<uint64_t>(_records.size());
+    const uint64_t bucket_number = std::max<uint64_t>(1, (key_number + 3) / 4); // 平均每个桶4个键
+    const uint64_t slot_number = key_number + key_number / 32 + 1; // 负载约97%
+    std::vector<uint64_t> hashes(key_number);
+    std::vector<uint64_t> order(key_number);
+    std::vector<uint32_t> pilots;
+    std::vector<uint64_t> slot_keys;
+    uint64_t seed = 0;
+
+    for (int tries=0;; ++tries)
+    {
+        if (MAX_SEED_TRIES == tries)
+            THROW_EXCEPTION(utils::CStringUtils::format_string("failed to build static hash table of %" PRIu64" keys", key_number), EAGAIN);
+
+        seed = utils::CHashUtils::mix64(static_cast<uint64_t>(tries) + 1);
+        for (uint64_t i=0; i<key_number; ++i)
+        {
+            hashes[i] = utils::CHashUtils::xxhash64(_data.data()+_records[i].offset, _records[i].key_size, seed);
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), StaticHashKeyOrder(hashes, bucket_number));
+
+        // 哈希相同的两个键总是落到同一个槽：键也相同时是重复的键，否则换种子
+        bool collided = false;
+        for (uint64_t i=1; i<key_number; ++i)
+        {
+            const Record& lhs = _records[order[i-1]];
+            const Record& rhs = _records[order[i]];
+            if (hashes[order[i-1]] != hashes[order[i]])
+                continue;
+
+            const std::string_view lhs_key(_data.data()+lhs.offset, lhs.key_size);
+            if (lhs_key == std::string_view(_data.data()+rhs.offset, rhs.key_size))
+                THROW_EXCEPTION(utils::CStringUtils::format_string("duplicate key: %.*s", static_cast<int>(lhs_key.size()), lhs_key.data()), EEXIST);
+            collided = true;
+        }
+        if (!collided && find_pilots(hashes, order, bucket_number, slot_number, &pilots, &slot_keys))
+            break;
+    }
+
+    // 记录按加入的顺序存放
+    table_header_t header;
+    std::vector<uint64_t> record_offsets(key_number);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    header.version = TABLE_VERSION;
+    header.seed = seed;
+    header.key_number = key_number;
+    header.bucket_number = bucket_number;
+    header.slot_number = slot_number;
+    header.records_offset = get_slots_offset(bucket_number) + slot_number * sizeof(static_hash_slot_t);
+    header.table_size = header.records_offset;
+    for (uint64_t i=0; i<key_number; ++i)
+    {
+        record_offsets[i] = header.table_size;
+        header.table_size += RECORD_HEADER_SIZE + _records[i].key_size + _records[i].value_size;
+    }
+
+    std::vector<static_hash_slot_t> slots(slot_number);
+    memset(&slots[0], 0, slot_number * sizeof(static_hash_slot_t));
+    for (uint64_t i=0; i<slot_number; ++i)
+    {
+        if (slot_keys[i] > 0)
+        {
+            const uint64_t k = slot_keys[i] - 1;
+            slots[i].record_offset = record_offsets[k];
+            slots[i].fingerprint = static_cast<uint32_t>(hashes[k] >> 32);
+            slots[i].key_size = _records[k].key_size;
+        }
+    }
+
+    const std::string tmp_filepath = filepath + ".tmp";
+    const int fd = ::open(tmp_filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("open %s error: %s", tmp_filepath.c_str(), strerror(errno)), errno, "open");
+
+    try
+    {
+        const char padding[8] = { 0 };
+        write_data(fd, &header, sizeof(header), tmp_filepath);
+        write_data(fd, &pilots[0], bucket_number * sizeof(uint32_t), tmp_filepath);
+        write_data(fd, padding, get_slots_offset(bucket_number) - sizeof(header) - bucket_number * sizeof(uint32_t), tmp_filepath);
+        write_data(fd, &slots[0], slot_number * sizeof(static_hash_slot_t), tmp_filepath);
+
+        // 记录攒成大块再写
+        std::string buffer;
+        buffer.reserve(SIZE_1M);
+        for (uint64_t i=0; i<key_number; ++i)
+        {
+            const uint32_t sizes[2] = { _records[i].key_size, _records[i].value_size };
+            buffer.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+            buffer.append(_data.data()+_records[i].offset, sizes[0]+sizes[1]);
+            if (buffer.size() >= SIZE_1M)
+            {
+                write_data(fd, buffer.data(), buffer.size(), tmp_filepath);
+                buffer.clear();
+            }
+        }
+        write_data(fd, buffer.data(), buffer.size(), tmp_filepath);
+
+        if (-1 == fsync(fd))
+            THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("fsync %s error: %s", tmp_filepath.c_str(), strerror(errno)), errno, "fsync");
+        ::close(fd);
+    }
+    catch (CSyscallException&)
+    {
+        ::close(fd);
+        (void)unlink(tmp_filepath.c_str());
+        throw;
+    }
+
+    if (-1 == rename(tmp_filepath.c_str(), filepath.c_str()))
+    {
+        const int errcode = errno;
+        (void)unlink(tmp_filepath.c_str());
+        THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("rename %s error: %s", tmp_filepath.c_str(), strerror(errcode)), errcode, "rename");
+    }
+}
+
+SYS_NAMESPACE_END
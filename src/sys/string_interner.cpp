@@ -0,0 +1,143 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/string_interner.h"
+#include "utils/exception.h"
+#include "utils/hash_utils.h"
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+SYS_NAMESPACE_BEGIN
+
+const CInternedString::Entry CInternedString::_empty_entry = { 0, 0, 0, "" };
+
+CInternedString::CInternedString()
+    : _entry(&_empty_entry)
+{
+}
+
+CStringInterner* CStringInterner::get_singleton()
+{
+    // 不释放，以便其它全局对象析构时仍可使用
+    static CStringInterner* interner = new CStringInterner;
+    return interner;
+}
+
+CStringInterner::CStringInterner()
+    : _size(1)
+{
+    memset(_chunks, 0, sizeof(_chunks));
+    _chunks[0] = new const CInternedString::Entry*[1 << CHUNK_BITS];
+    _chunks[0][0] = &CInternedString::_empty_entry;
+}
+
+CStringInterner::~CStringInterner()
+{
+    for (int i=0; i<CHUNK_NUMBER; ++i)
+        delete []_chunks[i];
+}
+
+CInternedString CStringInterner::intern(std::string_view str)
+{
+    if (str.empty())
+        return CInternedString();
+
+    const uint64_t hash = utils::CHashUtils::xxhash64(str.data(), str.size());
+    Shard& shard = _shards[(hash >> 32) & (SHARD_NUMBER-1)];
+    LockHelper<CLock> lock_helper(shard.lock);
+
+    EntryTable::const_iterator iter = shard.table.find(str);
+    if (iter != shard.table.end())
+        return CInternedString(iter->second);
+
+    CInternedString::Entry* entry = static_cast<CInternedString::Entry*>(
+            shard.arena.allocate(offsetof(CInternedString::Entry, str) + str.size() + 1, sizeof(uint64_t)));
+    entry->hash = hash;
+    entry->size = static_cast<uint32_t>(str.size());
+    memcpy(entry->str, str.data(), str.size());
+    entry->str[str.size()] = '\0';
+    entry->id = add_entry(entry);
+
+    // 键指向Arena中的副本，而不是调用者的str
+    (void)shard.table.insert(std::string_view(entry->str, entry->size), entry);
+    return CInternedString(entry);
+}
+
+bool CStringInterner::find(std::string_view str, CInternedString* interned) const
+{
+    if (str.empty())
+    {
+        *interned = CInternedString();
+        return true;
+    }
+
+    const uint64_t hash = utils::CHashUtils::xxhash64(str.data(), str.size());
+    Shard& shard = _shards[(hash >> 32) & (SHARD_NUMBER-1)];
+    LockHelper<CLock> lock_helper(shard.lock);
+
+    EntryTable::const_iterator iter = shard.table.find(str);
+    if (iter == shard.table.end())
+        return false;
+
+    *interned = CInternedString(iter->second);
+    return true;
+}
+
+CInternedString CStringInterner::get(uint32_t id) const
+{
+    if (id >= size())
+        return CInternedString();
+
+    const CInternedString::Entry** chunk = __atomic_load_n(&_chunks[id >> CHUNK_BITS], __ATOMIC_ACQUIRE);
+    return CInternedString(chunk[id & ((1 << CHUNK_BITS)-1)]);
+}
+
+uint32_t CStringInterner::size() const
+{
+    return __atomic_load_n(&_size, __ATOMIC_ACQUIRE);
+}
+
+size_t CStringInterner::get_allocated_bytes() const
+{
+    size_t allocated_bytes = 0;
+    for (int i=0; i<SHARD_NUMBER; ++i)
+    {
+        LockHelper<CLock> lock_helper(_shards[i].lock);
+        allocated_bytes += _shards[i].arena.get_allocated_bytes();
+    }
+    return allocated_bytes;
+}
+
+uint32_t CStringInterner::add_entry(CInternedString::Entry* entry)
+{
+    LockHelper<CLock> lock_helper(_id_lock);
+    const uint32_t id = _size;
+    if (id >= static_cast<uint32_t>(STRING_MAX))
+        THROW_EXCEPTION("too many interned strings", ENOSPC);
+
+    const CInternedString::Entry**& chunk = _chunks[id >> CHUNK_BITS];
+    if (NULL == chunk)
+        __atomic_store_n(&chunk, new const CInternedString::Entry*[1 << CHUNK_BITS], __ATOMIC_RELEASE);
+    chunk[id & ((1 << CHUNK_BITS)-1)] = entry;
+
+    // 先填好ID表再增加个数，get看到个数增加时该项一定已可用
+    __atomic_store_n(&_size, id+1, __ATOMIC_RELEASE);
+    return id;
+}
+
+SYS_NAMESPACE_END
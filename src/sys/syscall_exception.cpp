@@ -27,7 +27,7 @@ CSyscallException::CSyscallException(
     : utils::CException(errmsg, errcode, file, line)
 {
     if (NULL == errmsg)
-        _errmsg = strerror(errno);
+        _errmsg = strerror(errcode);
 
     if (syscall != NULL)
         _syscall = syscall;
@@ -38,7 +38,7 @@ CSyscallException::CSyscallException(
     : CException(errmsg, errcode, file, line)
 {
     if (errmsg.empty())
-        _errmsg = strerror(errno);
+        _errmsg = strerror(errcode);
 
     if (!syscall.empty())
         _syscall = syscall;
@@ -0,0 +1,445 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/task_executor.h"
+#include "sys/log.h"
+#include "sys/thread.h"
+#include "sys/utils.h"
+#include "utils/exception.h"
+#include <exception>
+SYS_NAMESPACE_BEGIN
+
+// 空闲时的最长睡眠毫秒数，正常情况下由提交任务唤醒，这里只是兜底
+#define TASK_IDLE_MILLISECONDS 100
+
+// 当前线程所属的执行器和工作线程编号，非工作线程的_current_executor为NULL
+static __thread CTaskExecutor* sg_current_executor = NULL;
+static __thread uint16_t sg_current_index = 0;
+
+//////////////////////////////////////////////////////////////////////////
+// CTaskWorker
+
+class CTaskWorker: public CThread
+{
+public:
+    CTaskWorker(CTaskExecutor* executor, uint16_t index)
+        :_executor(executor)
+        ,_index(index)
+        ,_idle(false)
+    {
+    }
+
+    bool is_idle() const { return __atomic_load_n(&_idle, __ATOMIC_SEQ_CST); }
+
+private:
+    virtual void run();
+
+private:
+    CTaskExecutor* _executor;
+    uint16_t _index;
+    volatile bool _idle;
+};
+
+void CTaskWorker::run()
+{
+    sg_current_executor = _executor;
+    sg_current_index = _index;
+
+    for (;;)
+    {
+        CTaskExecutor::Task* task = _executor->take_task(_index);
+        if (task != NULL)
+        {
+            _executor->execute(task);
+            continue;
+        }
+
+        // 先声明空闲再检查，和submit中先增加任务数再检查空闲配对，保证不会漏掉唤醒
+        __atomic_store_n(&_idle, true, __ATOMIC_SEQ_CST);
+        if (_executor->get_pending_number() > 0)
+        {
+            __atomic_store_n(&_idle, false, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        // 停止时，所有任务都已执行完才退出
+        if (is_stop())
+            break;
+
+        do_millisleep(TASK_IDLE_MILLISECONDS);
+        __atomic_store_n(&_idle, false, __ATOMIC_SEQ_CST);
+    }
+
+    sg_current_executor = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CTaskFuture
+
+CTaskFuture::CTaskFuture()
+    :_done(false)
+    ,_failed(false)
+{
+}
+
+bool CTaskFuture::is_done() const
+{
+    LockHelper<CLock> lock_helper(_lock);
+    return _done;
+}
+
+void CTaskFuture::wait()
+{
+    LockHelper<CLock> lock_helper(_lock);
+    while (!_done)
+        _event.wait(_lock);
+}
+
+bool CTaskFuture::timed_wait(uint32_t milliseconds)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    if (!_done)
+        (void)_event.timed_wait(_lock, milliseconds);
+    return _done;
+}
+
+void CTaskFuture::reset()
+{
+    LockHelper<CLock> lock_helper(_lock);
+    _done = false;
+    _failed = false;
+    _error.clear();
+}
+
+void CTaskFuture::set_done(const char* error)
+{
+    LockHelper<CLock> lock_helper(_lock);
+    _done = true;
+    if (error != NULL)
+    {
+        _failed = true;
+        _error = error;
+    }
+
+    _event.broadcast();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CTaskExecutor
+
+CTaskExecutor::TaskQueue::~TaskQueue()
+{
+    while (free_tasks != NULL)
+    {
+        Task* task = free_tasks;
+        free_tasks = task->next;
+        delete task;
+    }
+}
+
+CTaskExecutor::CTaskExecutor()
+    :_accepting(false)
+    ,_next_queue(0)
+    ,_pending_number(0)
+    ,_executed_number(0)
+    ,_stolen_number(0)
+    ,_expired_number(0)
+    ,_scheduler(NULL)
+{
+}
+
+CTaskExecutor::~CTaskExecutor()
+{
+    destroy();
+}
+
+void CTaskExecutor::create(uint16_t worker_number)
+{
+    if (0 == worker_number)
+    {
+        worker_number = CUtils::get_cpu_number();
+        if (0 == worker_number)
+            worker_number = 1;
+    }
+
+    // 先创建好所有队列，线程启动后即可能窃取
+    for (uint16_t i=0; i<worker_number; ++i)
+        _queues.push_back(new TaskQueue);
+    if (!_lane_weights.empty())
+        _scheduler = new CTaskScheduler<Task*>(_lane_weights);
+
+    _accepting = true;
+    for (uint16_t i=0; i<worker_number; ++i)
+    {
+        try
+        {
+            CTaskWorker* worker = new CTaskWorker(this, i);
+
+            worker->inc_refcount();
+            _workers.push_back(worker);
+            worker->start();
+        }
+        catch (...)
+        {
+            destroy();
+            throw;
+        }
+    }
+}
+
+void CTaskExecutor::destroy()
+{
+    _accepting = false;
+
+    // 先全部通知停止，再逐个等待，使得各线程同时参与排空
+    for (std::vector<CTaskWorker*>::size_type i=0; i<_workers.size(); ++i)
+        _workers[i]->stop(false);
+    for (std::vector<CTaskWorker*>::size_type i=0; i<_workers.size(); ++i)
+    {
+        try
+        {
+            _workers[i]->join();
+        }
+        catch (CSyscallException& ex)
+        {
+            MYLOG_ERROR("join task worker[%d] error: %s\n", static_cast<int>(i), ex.str().c_str());
+        }
+
+        _workers[i]->dec_refcount();
+    }
+    _workers.clear();
+
+    // 线程启动失败时，队列中可能还有任务，在调用者线程中执行完
+    if (!_queues.empty())
+    {
+        Task* task;
+        while ((task = take_task(0)) != NULL)
+            execute(task);
+    }
+    for (std::vector<TaskQueue*>::size_type i=0; i<_queues.size(); ++i)
+        delete _queues[i];
+    _queues.clear();
+    delete _scheduler;
+    _scheduler = NULL;
+}
+
+bool CTaskExecutor::submit(utils::Functor<void> functor, CTaskFuture* future)
+{
+    return push_task(&functor, NULL, future, CTaskPriority());
+}
+
+bool CTaskExecutor::submit(utils::Functor<void> functor, utils::Functor<void> callback)
+{
+    return push_task(&functor, &callback, NULL, CTaskPriority());
+}
+
+bool CTaskExecutor::submit(utils::Functor<void> functor, const CTaskPriority& priority, CTaskFuture* future)
+{
+    return push_task(&functor, NULL, future, priority);
+}
+
+bool CTaskExecutor::submit(utils::Functor<void> functor, const CTaskPriority& priority, utils::Functor<void> callback)
+{
+    return push_task(&functor, &callback, NULL, priority);
+}
+
+// 被丢弃的任务由调用者的functor和callback析构
+bool CTaskExecutor::push_task(utils::Functor<void>* functor, utils::Functor<void>* callback, CTaskFuture* future, const CTaskPriority& priority)
+{
+    uint16_t index;
+    const bool in_worker = (this == sg_current_executor);
+
+    // 销毁过程中，工作线程中仍可提交，以免任务中再提交的子任务丢失
+    if (_queues.empty() || (!_accepting && !in_worker))
+        return false;
+
+    if (in_worker)
+        index = sg_current_index;
+    else
+        index = static_cast<uint16_t>(__atomic_fetch_add(&_next_queue, 1, __ATOMIC_RELAXED) % _queues.size());
+
+    // 先增加任务数再入队，任务数总不小于队列中的任务个数
+    __atomic_add_fetch(&_pending_number, 1, __ATOMIC_SEQ_CST);
+    {
+        TaskQueue* queue = _queues[index];
+        LockHelper<CLock> lock_helper(queue->lock);
+        Task* task = queue->free_tasks;
+        if (task != NULL)
+            queue->free_tasks = task->next;
+        else
+            task = new Task;
+
+        task->function = static_cast<utils::Functor<void>&&>(*functor);
+        if (callback != NULL)
+            task->callback = static_cast<utils::Functor<void>&&>(*callback);
+        task->future = future;
+        task->deadline = priority.deadline_milliseconds;
+        if (NULL == _scheduler)
+        {
+            queue->tasks.push_back(task);
+        }
+        else
+        {
+            // 任务对象仍取自各队列的空闲链表，只是排队在共享的调度队列中
+            LockHelper<CLock> scheduler_lock_helper(_scheduler_lock);
+            _scheduler->push(task, priority);
+        }
+    }
+
+    wakeup_idle(index);
+    return true;
+}
+
+void CTaskExecutor::wakeup_idle(uint16_t index)
+{
+    // 优先唤醒队列所属的线程，它忙时唤醒一个空闲的线程来窃取
+    const std::vector<CTaskWorker*>::size_type worker_number = _workers.size();
+    for (std::vector<CTaskWorker*>::size_type i=0; i<worker_number; ++i)
+    {
+        CTaskWorker* worker = _workers[(index + i) % worker_number];
+        if (worker->is_idle())
+        {
+            worker->wakeup();
+            break;
+        }
+    }
+}
+
+CTaskExecutor::Task* CTaskExecutor::take_task(uint16_t index)
+{
+    if (_scheduler != NULL)
+        return take_scheduled_task();
+
+    Task* task = NULL;
+    const std::vector<TaskQueue*>::size_type queue_number = _queues.size();
+
+    { // 自己的队列，从尾部取
+        TaskQueue* queue = _queues[index];
+        LockHelper<CLock> lock_helper(queue->lock);
+        if (!queue->tasks.empty())
+        {
+            task = queue->tasks.back();
+            queue->tasks.pop_back();
+        }
+    }
+
+    // 窃取其它队列的，从头部取
+    for (std::vector<TaskQueue*>::size_type i=1; (NULL == task) && (i<queue_number); ++i)
+    {
+        TaskQueue* queue = _queues[(index + i) % queue_number];
+        LockHelper<CLock> lock_helper(queue->lock);
+        if (!queue->tasks.empty())
+        {
+            task = queue->tasks.front();
+            queue->tasks.pop_front();
+            __atomic_add_fetch(&_stolen_number, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (task != NULL)
+        __atomic_sub_fetch(&_pending_number, 1, __ATOMIC_SEQ_CST);
+    return task;
+}
+
+// 调度队列中已过期的任务在这里即结束，不交给调用者
+CTaskExecutor::Task* CTaskExecutor::take_scheduled_task()
+{
+    Task* task = NULL;
+    std::vector<Task*> expired;
+    bool taken;
+
+    {
+        LockHelper<CLock> lock_helper(_scheduler_lock);
+        taken = _scheduler->pop(CClock::get_milliseconds(), &task, &expired);
+    }
+
+    const uint32_t number = static_cast<uint32_t>(expired.size() + (taken? 1: 0));
+    if (number > 0)
+        __atomic_sub_fetch(&_pending_number, number, __ATOMIC_SEQ_CST);
+    for (std::vector<Task*>::size_type i=0; i<expired.size(); ++i)
+    {
+        __atomic_add_fetch(&_expired_number, 1, __ATOMIC_RELAXED);
+        finish(expired[i], "deadline exceeded");
+    }
+    return taken? task: NULL;
+}
+
+void CTaskExecutor::execute(Task* task)
+{
+    std::string error;
+    bool failed = false;
+
+    // 在队列中等待时已过了截止时间
+    if ((task->deadline != 0) && (task->deadline < CClock::get_milliseconds()))
+    {
+        __atomic_add_fetch(&_expired_number, 1, __ATOMIC_RELAXED);
+        finish(task, "deadline exceeded");
+        return;
+    }
+
+    try
+    {
+        task->function();
+    }
+    catch (utils::CException& ex)
+    {
+        failed = true;
+        error = ex.str();
+    }
+    catch (std::exception& ex)
+    {
+        failed = true;
+        error = ex.what();
+    }
+    catch (...)
+    {
+        failed = true;
+        error = "unknown exception";
+    }
+
+    if (failed && (NULL == task->future))
+        MYLOG_ERROR("task error: %s\n", error.c_str());
+    finish(task, failed? error.c_str(): NULL);
+    __atomic_add_fetch(&_executed_number, 1, __ATOMIC_RELAXED);
+}
+
+// 通知完成并回收任务对象，error为NULL表示成功
+void CTaskExecutor::finish(Task* task, const char* error)
+{
+    if (!task->callback.empty())
+        task->callback();
+    if (task->future != NULL)
+        task->future->set_done(error);
+
+    free_task(task);
+}
+
+// 回收到执行线程自己的队列，提交到该队列的任务复用它
+void CTaskExecutor::free_task(Task* task)
+{
+    // 先在锁外析构绑定的函数对象
+    task->function = utils::Functor<void>();
+    task->callback = utils::Functor<void>();
+
+    TaskQueue* queue = _queues[(this == sg_current_executor)? sg_current_index: 0];
+    LockHelper<CLock> lock_helper(queue->lock);
+    task->next = queue->free_tasks;
+    queue->free_tasks = task;
+}
+
+SYS_NAMESPACE_END
@@ -17,14 +17,24 @@
  * Author: jian yi, eyjian@qq.com
  */
 #include "sys/thread.h"
+#include "sys/info.h"
 SYS_NAMESPACE_BEGIN
 
 static void* thread_proc(void* thread_param)
 {
     CThread* thread = (CThread *)thread_param;
     //thread->inc_refcount(); // start中已经调用，可以确保这里可以安全的使用thread指针
+    const std::string name = thread->get_name();
+    if (!name.empty())
+    {
+        // 系统的线程名最长15个字节，超出时pthread_setname_np返回ERANGE
+        (void)pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+        CThreadSampler::register_current_thread(name);
+    }
 
     thread->run();
+    if (!name.empty())
+        CThreadSampler::unregister_current_thread();
     thread->dec_refcount();
     return NULL;
 }
@@ -66,6 +76,23 @@ void CThread::start(bool detach)
             THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_attr_setstacksize");
     }
 
+    // 设置CPU亲和性，在创建时即生效，避免线程先在其它CPU上运行再迁移
+    if (!_cpus.empty())
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (std::vector<int>::size_type i=0; i<_cpus.size(); ++i)
+        {
+            if ((_cpus[i] < 0) || (_cpus[i] >= CPU_SETSIZE))
+                THROW_SYSCALL_EXCEPTION(NULL, EINVAL, "CPU_SET");
+            CPU_SET(_cpus[i], &cpu_set);
+        }
+
+        errcode = pthread_attr_setaffinity_np(&_attr, sizeof(cpu_set), &cpu_set);
+        if (errcode != 0)
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_attr_setaffinity_np");
+    }
+
     errcode = pthread_attr_setdetachstate(&_attr, detach?PTHREAD_CREATE_DETACHED:PTHREAD_CREATE_JOINABLE);
     if (errcode != 0)
         THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_attr_setdetachstate");
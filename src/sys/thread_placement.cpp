@@ -0,0 +1,101 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/thread_placement.h"
+#include "sys/utils.h"
+#include <algorithm>
+SYS_NAMESPACE_BEGIN
+
+CThreadPlacement::CThreadPlacement(placement_policy_t policy, const std::vector<int>& cpus)
+    :_policy(policy)
+    ,_explicit_cpus(cpus)
+{
+    if (placement_none == _policy)
+        return;
+
+    // 节点编号可能不连续，没有CPU的节点（如纯内存节点）不参与放置
+    const uint16_t node_number = CUtils::get_numa_node_number();
+    for (uint16_t node=0; node<node_number; ++node)
+    {
+        std::vector<int> node_cpus;
+        if (CUtils::get_numa_node_cpus(node, &node_cpus) && !node_cpus.empty())
+        {
+            _node_cpus.push_back(node_cpus);
+            _node_ids.push_back(node);
+            _compact_cpus.insert(_compact_cpus.end(), node_cpus.begin(), node_cpus.end());
+        }
+    }
+}
+
+std::vector<int> CThreadPlacement::get_cpus(uint16_t index) const
+{
+    std::vector<int> cpus;
+
+    switch (_policy)
+    {
+    case placement_compact:
+        if (!_compact_cpus.empty())
+            cpus.push_back(_compact_cpus[index % _compact_cpus.size()]);
+        break;
+
+    case placement_scatter:
+        if (!_node_cpus.empty())
+        {
+            const std::vector<int>& node_cpus = _node_cpus[index % _node_cpus.size()];
+            cpus.push_back(node_cpus[(index / _node_cpus.size()) % node_cpus.size()]);
+        }
+        break;
+
+    case placement_explicit:
+        if (!_explicit_cpus.empty())
+            cpus.push_back(_explicit_cpus[index % _explicit_cpus.size()]);
+        break;
+
+    case placement_numa_node:
+        if (!_node_cpus.empty())
+            cpus = _node_cpus[index % _node_cpus.size()];
+        break;
+
+    default:
+        break;
+    }
+
+    return cpus;
+}
+
+int CThreadPlacement::get_numa_node(uint16_t index) const
+{
+    if (placement_numa_node == _policy)
+        return _node_ids.empty()? -1: _node_ids[index % _node_ids.size()];
+
+    const std::vector<int> cpus = get_cpus(index);
+    return cpus.empty()? -1: get_cpu_node(cpus[0]);
+}
+
+int CThreadPlacement::get_cpu_node(int cpu) const
+{
+    for (std::vector<std::vector<int> >::size_type i=0; i<_node_cpus.size(); ++i)
+    {
+        if (std::binary_search(_node_cpus[i].begin(), _node_cpus[i].end(), cpu))
+            return _node_ids[i];
+    }
+
+    return -1;
+}
+
+SYS_NAMESPACE_END
@@ -1,5 +1,6 @@
 // Writed by yijian on 2019/2/27
 #include "sys/time_thread.h"
+#include "sys/clock.h"
 #include "sys/log.h"
 #include <sys/time.h>
 SYS_NAMESPACE_BEGIN
@@ -14,12 +15,15 @@ CTimeThread::CTimeThread()
     struct timeval tv;
     gettimeofday(&tv, NULL);
 
+    const int64_t milliseconds = static_cast<int64_t>(tv.tv_sec)*1000 + tv.tv_usec/1000;
 #if __WORDSIZE==64
     _seconds = static_cast<int64_t>(tv.tv_sec);
-    _milliseconds = static_cast<int64_t>(tv.tv_usec);
+    _milliseconds = milliseconds;
+    _monotonic_milliseconds = static_cast<int64_t>(CClock::get_milliseconds());
 #else
     _seconds = static_cast<int>(tv.tv_sec);
-    _milliseconds = static_cast<int>(tv.tv_usec);
+    _milliseconds = static_cast<int>(milliseconds);
+    _monotonic_milliseconds = static_cast<int>(CClock::get_milliseconds());
 #endif // __WORDSIZE==64
 }
 
@@ -46,6 +50,15 @@ int64_t CTimeThread::get_milliseconds() const
 #endif // __WORDSIZE==64
 }
 
+int64_t CTimeThread::get_monotonic_milliseconds() const
+{
+#if __WORDSIZE==64
+    return _monotonic_milliseconds.operator int64_t();
+#else
+    return _monotonic_milliseconds.operator int();
+#endif // __WORDSIZE==64
+}
+
 void CTimeThread::stop()
 {
     _stop = true;
@@ -78,8 +91,9 @@ void CTimeThread::wait()
 
 void CTimeThread::run()
 {
-    struct timeval start_tv, exit_tv;
-    gettimeofday(&start_tv, NULL);
+    const uint64_t start_milliseconds = CClock::get_milliseconds();
+    const uint64_t interval_milliseconds = (0 == _interval_milliseconds)? 1: _interval_milliseconds;
+    uint64_t next_milliseconds = start_milliseconds;
 
     MYLOG_INFO("Time-thread start now\n");
     while (!_stop)
@@ -87,29 +101,26 @@ void CTimeThread::run()
         struct timeval tv;
         gettimeofday(&tv, NULL);
 
-        const int64_t milliseconds = static_cast<int64_t>(tv.tv_sec*1000 + tv.tv_usec/1000);
+        const int64_t milliseconds = static_cast<int64_t>(tv.tv_sec)*1000 + tv.tv_usec/1000;
+        const uint64_t monotonic_milliseconds = CClock::get_milliseconds();
 #if __WORDSIZE==64
         _seconds = static_cast<int64_t>(tv.tv_sec);
         _milliseconds = milliseconds;
+        _monotonic_milliseconds = static_cast<int64_t>(monotonic_milliseconds);
 #else
         _seconds = static_cast<int>(tv.tv_sec);
         _milliseconds = static_cast<int>(milliseconds);
+        _monotonic_milliseconds = static_cast<int>(monotonic_milliseconds);
 #endif // __WORDSIZE==64
 
-        CUtils::millisleep(_interval_milliseconds);
+        // 睡到下一个对齐的时间点，错过的时间点直接跳过
+        next_milliseconds += interval_milliseconds;
+        if (next_milliseconds <= monotonic_milliseconds)
+            next_milliseconds = monotonic_milliseconds - (monotonic_milliseconds - start_milliseconds) % interval_milliseconds + interval_milliseconds;
+        CUtils::millisleep(static_cast<uint32_t>(next_milliseconds - monotonic_milliseconds));
     }
 
-    gettimeofday(&exit_tv, NULL);
-    if (start_tv.tv_sec<=exit_tv.tv_sec ||
-        start_tv.tv_usec<=exit_tv.tv_usec)
-    {
-        const uint64_t interval_milliseconds = (exit_tv.tv_sec-start_tv.tv_sec)*1000 + (exit_tv.tv_usec-start_tv.tv_usec)/1000;
-        MYLOG_INFO("Time-thread exit now: %" PRIu64"ms\n", interval_milliseconds);
-    }
-    else
-    {
-        MYLOG_INFO("Time-thread exit now\n");
-    }
+    MYLOG_INFO("Time-thread exit now: %" PRIu64"ms\n", CClock::get_milliseconds()-start_milliseconds);
 }
 
 SYS_NAMESPACE_END
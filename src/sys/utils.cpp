@@ -20,6 +20,8 @@
 #include "sys/atomic.h"
 #include "sys/close_helper.h"
 #include "sys/dir_utils.h"
+#include "sys/fiber.h"
+#include "sys/process_table.h"
 #include "utils/string_utils.h"
 
 #if __cplusplus >= 201103L
@@ -31,7 +33,6 @@
 #include <dirent.h>
 #include <execinfo.h> // backtrace和backtrace_symbols函数
 #include <features.h> // feature_test_macros
-#include <ftw.h> // ftw
 #include <libgen.h> // dirname&basename
 #include <poll.h>
 #include <pwd.h> // getpwuid
@@ -40,6 +41,7 @@
 #include <sys/time.h>
 #include <sys/prctl.h> // prctl
 #include <sys/resource.h>
+#include <sys/syscall.h> // SYS_mbind
 #include <sys/types.h>
 #include <time.h>
 
@@ -51,6 +53,15 @@
 #define PR_GET_NAME 16
 #endif
 
+// 同linux/mempolicy.h，不依赖libnuma
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1<<1)
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 SYS_NAMESPACE_BEGIN
 
@@ -120,6 +131,13 @@ uint64_t CUtils::rdtsc()
 // unsigned int sleep(unsigned int seconds);
 void CUtils::millisleep(uint32_t milliseconds)
 {
+    // 纤程中只挂起纤程，不阻塞载体线程
+    if (CFiberScheduler::in_fiber())
+    {
+        CFiberScheduler::sleep(milliseconds);
+        return;
+    }
+
     struct timespec ts = { milliseconds / 1000, (milliseconds % 1000) * 1000000 };
     while ((-1 == nanosleep(&ts, &ts)) && (EINTR == errno));
 
@@ -286,50 +304,10 @@ std::string CUtils::get_program_dirpath()
 
 int CUtils::get_program_parameters(std::vector<std::string>* parameters, uint32_t pid)
 {
-    char* raw_full_cmdline_buf = new char[PATH_MAX];
-
-    std::string cmdline_filepath;
-    if (0 == pid)
-        cmdline_filepath = "/proc/self/cmdline";
-    else
-        cmdline_filepath = utils::CStringUtils::format_string("/proc/%u/cmdline", pid);
-
-    const int fd = open(cmdline_filepath.c_str(), O_RDONLY);
-    if (fd != -1)
-    {
-        const int n = read(fd, raw_full_cmdline_buf, PATH_MAX-1);
-        if (n != -1)
-        {
-            raw_full_cmdline_buf[n] = '\0';
-
-            std::string parameter;
-            for (int i=0; i<=n; ++i)
-            {
-                if (i == n)
-                {
-                    if (!parameter.empty())
-                        parameters->push_back(parameter);
-                    break;
-                }
-                if ('\0' == raw_full_cmdline_buf[i])
-                {
-                    if (!parameter.empty())
-                    {
-                        parameters->push_back(parameter);
-                        parameter.clear();
-                    }
-                }
-                else
-                {
-                    parameter.push_back(raw_full_cmdline_buf[i]);
-                }
-            }
-        }
-
-        close(fd);
-    }
-
-    delete []raw_full_cmdline_buf;
+    // 完整读取，不受PATH_MAX的限制
+    std::string cmdline;
+    if (CProcessTable::read_cmdline(pid, &cmdline))
+        CProcessTable::split_cmdline(cmdline.data(), cmdline.size(), parameters);
     return static_cast<int>(parameters->size());
 }
 
@@ -422,6 +400,8 @@ uint16_t CUtils::get_cpu_number()
 		*value++ = 0;		
 		if (0 == strncmp("processor", name, sizeof("processor")-1))
 		{
+			 // 值的格式为“\t: 0\n”，需去掉两端的空白
+			 utils::CStringUtils::trim(value);
 			 if (!utils::CStringUtils::string2uint16(value, cpu_number))
              {
                  return 0;
@@ -432,6 +412,101 @@ uint16_t CUtils::get_cpu_number()
 	return (cpu_number+1);
 }
 
+// 解析形如“0-3,8-11”的列表，结果追加到numbers
+static void parse_number_list(const char* list, std::vector<int>* numbers)
+{
+    const char* str = list;
+    while (*str != '\0')
+    {
+        char* end;
+        const long first = strtol(str, &end, 10);
+        if (end == str)
+            break;
+
+        long last = first;
+        if ('-' == *end)
+        {
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if (end == str)
+                break;
+        }
+        for (long i=first; i<=last; ++i)
+            numbers->push_back(static_cast<int>(i));
+
+        str = end;
+        if (*str != ',')
+            break;
+        ++str;
+    }
+}
+
+// 读取sysfs文件的第一行
+static bool read_sysfs_line(const char* filepath, char* line, int line_size)
+{
+    FILE* fp = fopen(filepath, "r");
+    if (NULL == fp)
+        return false;
+
+    sys::CloseHelper<FILE*> ch(fp);
+    return fgets(line, line_size, fp) != NULL;
+}
+
+uint16_t CUtils::get_numa_node_number()
+{
+    char line[LINE_MAX];
+    std::vector<int> nodes;
+
+    if (!read_sysfs_line("/sys/devices/system/node/online", line, sizeof(line)))
+        return 1;
+
+    // 节点编号可能不连续，以最大编号为准
+    parse_number_list(line, &nodes);
+    return nodes.empty()? 1: static_cast<uint16_t>(nodes.back()+1);
+}
+
+bool CUtils::get_numa_node_cpus(int node, std::vector<int>* cpus)
+{
+    char line[LINE_MAX];
+    char filepath[sizeof("/sys/devices/system/node/node2147483647/cpulist")];
+
+    cpus->clear();
+    if (node < 0)
+        return false;
+
+    snprintf(filepath, sizeof(filepath), "/sys/devices/system/node/node%d/cpulist", node);
+    if (read_sysfs_line(filepath, line, sizeof(line)))
+    {
+        parse_number_list(line, cpus);
+        return true;
+    }
+
+    // 没有NUMA信息时，节点0包含所有CPU
+    if (0 == node)
+    {
+        const uint16_t cpu_number = get_cpu_number();
+        for (uint16_t i=0; i<cpu_number; ++i)
+            cpus->push_back(i);
+        return true;
+    }
+
+    return false;
+}
+
+bool CUtils::bind_numa_node(void* addr, size_t size, int node)
+{
+    if ((node < 0) || (node >= static_cast<int>(sizeof(unsigned long)*8)) || (0 == size))
+        return false;
+
+    // mbind要求起始地址页对齐
+    const uintptr_t page_size = static_cast<uintptr_t>(get_page_size());
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(page_size-1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(addr) + size;
+    const unsigned long nodemask = 1UL << node;
+
+    return 0 == syscall(SYS_mbind, begin, end-begin, MPOL_PREFERRED, &nodemask, sizeof(nodemask)*8, MPOL_MF_MOVE);
+}
+
 bool CUtils::get_backtrace(std::string& call_stack)
 {
     const int frame_number_max = 20;       // 最大帧层数
@@ -461,21 +536,40 @@ bool CUtils::get_backtrace(std::string& call_stack)
     return true;
 }
 
-static off_t dirsize; // 目录大小
-int _du_fn(const char *fpath, const struct stat *sb, int typeflag)
-{   
-    if (FTW_F == typeflag)
-        dirsize += sb->st_size;
+class CDuVisitor: public IDirVisitor
+{
+public:
+    CDuVisitor()
+        : _dirsize(0)
+    {
+    }
 
-    return 0;
-}
+    off_t get_dirsize() const { return _dirsize; }
 
-off_t CUtils::du(const char* dirpath)
-{
-    dirsize = 0;
-    if (ftw(dirpath, _du_fn, 0) != 0) return -1;
+private:
+    virtual void on_entry(const dir_entry_t& entry)
+    {
+        if ((DT_REG == entry.type) && (entry.st != NULL))
+            __atomic_add_fetch(&_dirsize, entry.st->st_size, __ATOMIC_RELAXED);
+    }
 
-    return dirsize;
+private:
+    off_t _dirsize;
+};
+
+off_t CUtils::du(const char* dirpath, int num_threads)
+{
+    try
+    {
+        CDuVisitor visitor;
+        CDirWalker dir_walker(num_threads, true);
+        dir_walker.walk(dirpath, &visitor);
+        return visitor.get_dirsize();
+    }
+    catch (CSyscallException& ex)
+    {
+        return -1;
+    }
 }
 
 int CUtils::get_page_size()
@@ -765,51 +859,17 @@ std::string CUtils::get_process_name(int64_t pid)
 
 int CUtils::get_all_pid(const std::string& process_name, std::vector<int64_t>* pid_array, bool regex)
 {
-    regex_t preg;
-
-    if (regex)
-    {
-        if (regcomp(&preg, process_name.c_str(), REG_EXTENDED) != 0)
-        {
-            return -1;
-        }
-    }
     try
     {
-        std::vector<std::string> subdir_names; // pid数组
-        CDirUtils::list("/proc", &subdir_names, NULL, NULL);
-
-        for (std::vector<std::string>::size_type i=0; i<subdir_names.size(); ++i)
-        {
-            const std::string& pid_str = subdir_names[i];
-            uint32_t pid = 0;
-
-            if (utils::CStringUtils::string2int(pid_str.c_str(), pid))
-            {
-                const std::string& process_name_ = get_process_name(pid);
-
-                if (!regex)
-                {
-                    if (process_name_ == process_name)
-                        pid_array->push_back(pid);
-                }
-                else
-                {
-                    regmatch_t pmatch[1]; // 存放匹配结果
-                    if (0 == regexec(&preg, process_name_.c_str(), 1, pmatch, 0))
-                        pid_array->push_back(pid);
-                }
-            }
-        }
+        CProcessNameFilter filter(process_name, regex);
+        CProcessTable process_table;
 
-        if (regex)
-            regfree(&preg);
+        process_table.scan(CProcessTable::PROCESS_STAT, 1, &filter);
+        process_table.get_pids(pid_array);
         return static_cast<int>(pid_array->size());
     }
-    catch (sys::CSyscallException& ex)
+    catch (utils::CException& ex)
     {
-        if (regex)
-            regfree(&preg);
         return -1;
     }
 }
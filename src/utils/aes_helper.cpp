@@ -18,8 +18,12 @@
  * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
  */
 #include "utils/aes_helper.h"
+#include "utils/scoped_ptr.h"
+#include "utils/string_utils.h"
 #if MOOON_HAVE_OPENSSL == 1
 #   include <openssl/aes.h>
+#   include <openssl/err.h>
+#   include <openssl/evp.h>
 #endif // MOOON_HAVE_OPENSSL
 UTILS_NAMESPACE_BEGIN
 
@@ -122,38 +126,230 @@ void CAESHelper::aes(bool flag, const std::string& in, std::string* out, void* a
 #if MOOON_HAVE_OPENSSL == 1
     AES_KEY* aes_key_ = (AES_KEY*)aes_key;
 
-    std::string in_tmp = in;
-    if (in.size() % AES_BLOCK_SIZE != 0)
+    // 只有最后不足一个块的部分需要补0，不再复制整个输入
+    const std::string::size_type full_size = in.size() - in.size() % AES_BLOCK_SIZE;
+    out->resize((full_size == in.size())? in.size(): full_size + AES_BLOCK_SIZE);
+
+    const unsigned char* in_p = (const unsigned char*)in.data();
+    unsigned char* out_p = (unsigned char*)const_cast<char*>(out->data());
+    for (std::string::size_type i=0; i<out->size(); i+=AES_BLOCK_SIZE)
     {
-        std::string::size_type tmp_size = in.size() + (AES_BLOCK_SIZE - in.size() % AES_BLOCK_SIZE);
-        in_tmp.resize(tmp_size);
+        unsigned char last_block[AES_BLOCK_SIZE];
+        const unsigned char* block = in_p + i;
+        if (i == full_size)
+        {
+            memset(last_block, 0, sizeof(last_block));
+            memcpy(last_block, in_p+i, in.size()-i);
+            block = last_block;
+        }
+
+        if (flag)
+            AES_encrypt(block, out_p+i, aes_key_); // 加密
+        else
+            AES_decrypt(block, out_p+i, aes_key_); // 解密
     }
+#else
+    *out = '\0'; // 需要加上这一句，不然难区分HAVE_OPENSSL值是否为1或不为1的情况
+#endif // MOOON_HAVE_OPENSSL
+}
 
-    const char* in_p = in_tmp.data();
-    out->resize(in_tmp.size());
-    char* out_p = const_cast<char*>(out->data());
+////////////////////////////////////////////////////////////////////////////////
+#if MOOON_HAVE_OPENSSL == 1
+static std::string get_openssl_errmsg(int* errcode)
+{
+    *errcode = static_cast<int>(ERR_get_error());
+    utils::ScopedArray<char> errmsg(new char[SIZE_4K]);
+    ERR_error_string_n(*errcode, errmsg.get(), SIZE_4K);
+    return errmsg.get();
+}
 
-    for (std::string::size_type i=0; i<in.size(); i+=AES_BLOCK_SIZE)
+#define THROW_OPENSSL_EXCEPTION(what) \
+    do { \
+        int errcode_; \
+        const std::string errmsg_ = get_openssl_errmsg(&errcode_); \
+        THROW_EXCEPTION(std::string(what) + ": " + errmsg_, errcode_); \
+    } while (0)
+
+static const EVP_CIPHER* get_evp_cipher(CAESCipher::cipher_mode_t mode, size_t key_size)
+{
+    if (CAESCipher::mode_gcm == mode)
+        return (16 == key_size)? EVP_aes_128_gcm(): ((24 == key_size)? EVP_aes_192_gcm(): EVP_aes_256_gcm());
+    return (16 == key_size)? EVP_aes_128_ctr(): ((24 == key_size)? EVP_aes_192_ctr(): EVP_aes_256_ctr());
+}
+#endif // MOOON_HAVE_OPENSSL
+
+CAESCipher::CAESCipher(const std::string& key, cipher_mode_t mode)
+    : _ctx(NULL), _mode(mode)
+{
+#if MOOON_HAVE_OPENSSL == 1
+    if ((key.size() != 16) && (key.size() != 24) && (key.size() != 32))
+        THROW_EXCEPTION(CStringUtils::format_string("invalid key size: %zu", key.size()), -2);
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (NULL == ctx)
+        THROW_OPENSSL_EXCEPTION("EVP_CIPHER_CTX_new");
+
+    // 只在这里展开密钥，之后每条消息只设置IV
+    if (1 != EVP_CipherInit_ex(ctx, get_evp_cipher(mode, key.size()), NULL, reinterpret_cast<const unsigned char*>(key.data()), NULL, 1))
     {
-        char out_tmp[AES_BLOCK_SIZE];
+        EVP_CIPHER_CTX_free(ctx);
+        THROW_OPENSSL_EXCEPTION("EVP_CipherInit_ex");
+    }
+    _ctx = ctx;
+#else
+    THROW_EXCEPTION("CAESCipher requires openssl", -1);
+#endif // MOOON_HAVE_OPENSSL
+}
 
-        if (flag) {
-            // 加密
-            //AES_ecb_encrypt((const unsigned char*)(in_p), (unsigned char*)(out_tmp), aes_key_, AES_ENCRYPT);
-            AES_encrypt((const unsigned char*)(in_p), (unsigned char*)(out_tmp), aes_key_);
-        }
-        else {
-            // 解密
-            //AES_ecb_encrypt((const unsigned char*)(in_p), (unsigned char*)(out_tmp), aes_key_, AES_DECRYPT);
-            AES_decrypt((const unsigned char*)(in_p), (unsigned char*)(out_tmp), aes_key_);
-        }
+CAESCipher::~CAESCipher()
+{
+#if MOOON_HAVE_OPENSSL == 1
+    EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX*>(_ctx));
+#endif // MOOON_HAVE_OPENSSL
+}
+
+void CAESCipher::begin_encrypt(const void* iv, size_t iv_size, const void* aad, size_t aad_size)
+{
+    begin(true, iv, iv_size, aad, aad_size);
+}
 
-        in_p += AES_BLOCK_SIZE;
-        memcpy(out_p+i, out_tmp, AES_BLOCK_SIZE);
+void CAESCipher::begin_decrypt(const void* iv, size_t iv_size, const void* aad, size_t aad_size)
+{
+    begin(false, iv, iv_size, aad, aad_size);
+}
+
+void CAESCipher::begin(bool encrypt, const void* iv, size_t iv_size, const void* aad, size_t aad_size)
+{
+#if MOOON_HAVE_OPENSSL == 1
+    EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(_ctx);
+
+    if (mode_gcm == _mode)
+    {
+        if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(iv_size), NULL))
+            THROW_OPENSSL_EXCEPTION("EVP_CTRL_GCM_SET_IVLEN");
+    }
+    else if (iv_size != ctr_iv_size)
+    {
+        THROW_EXCEPTION(CStringUtils::format_string("invalid iv size: %zu", iv_size), -2);
     }
+
+    // cipher和key为NULL时沿用构造时展开的密钥
+    if (1 != EVP_CipherInit_ex(ctx, NULL, NULL, NULL, static_cast<const unsigned char*>(iv), encrypt? 1: 0))
+        THROW_OPENSSL_EXCEPTION("EVP_CipherInit_ex");
+
+    if ((mode_gcm == _mode) && (aad_size > 0))
+    {
+        int outlen = 0;
+        if (1 != EVP_CipherUpdate(ctx, NULL, &outlen, static_cast<const unsigned char*>(aad), static_cast<int>(aad_size)))
+            THROW_OPENSSL_EXCEPTION("EVP_CipherUpdate(aad)");
+    }
+#endif // MOOON_HAVE_OPENSSL
+}
+
+size_t CAESCipher::update(const void* in, size_t size, void* out)
+{
+#if MOOON_HAVE_OPENSSL == 1
+    EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(_ctx);
+    const unsigned char* in_p = static_cast<const unsigned char*>(in);
+    unsigned char* out_p = static_cast<unsigned char*>(out);
+    size_t total = 0;
+
+    // EVP_CipherUpdate的长度为int，大块分段处理
+    while (total < size)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(size - total, 1U << 30));
+        int outlen = 0;
+        if (1 != EVP_CipherUpdate(ctx, out_p+total, &outlen, in_p+total, chunk))
+            THROW_OPENSSL_EXCEPTION("EVP_CipherUpdate");
+        total += static_cast<size_t>(outlen);
+    }
+    return total;
 #else
-    *out = '\0'; // 需要加上这一句，不然难区分HAVE_OPENSSL值是否为1或不为1的情况
+    return 0;
+#endif // MOOON_HAVE_OPENSSL
+}
+
+size_t CAESCipher::update(const struct iovec* iov, int iovcnt, void* out)
+{
+    size_t total = 0;
+    for (int i=0; i<iovcnt; ++i)
+        total += update(iov[i].iov_base, iov[i].iov_len, static_cast<char*>(out)+total);
+    return total;
+}
+
+void CAESCipher::finish_encrypt(void* tag, size_t tag_size)
+{
+#if MOOON_HAVE_OPENSSL == 1
+    EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(_ctx);
+    unsigned char final_block[EVP_MAX_BLOCK_LENGTH];
+    int outlen = 0;
+
+    // 流模式没有需要输出的尾部
+    if (1 != EVP_CipherFinal_ex(ctx, final_block, &outlen))
+        THROW_OPENSSL_EXCEPTION("EVP_CipherFinal_ex");
+    if ((mode_gcm == _mode) && (tag != NULL))
+    {
+        if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, static_cast<int>(tag_size), tag))
+            THROW_OPENSSL_EXCEPTION("EVP_CTRL_GCM_GET_TAG");
+    }
 #endif // MOOON_HAVE_OPENSSL
 }
 
+bool CAESCipher::finish_decrypt(const void* tag, size_t tag_size)
+{
+#if MOOON_HAVE_OPENSSL == 1
+    EVP_CIPHER_CTX* ctx = static_cast<EVP_CIPHER_CTX*>(_ctx);
+    unsigned char final_block[EVP_MAX_BLOCK_LENGTH];
+    int outlen = 0;
+
+    if (mode_gcm == _mode)
+    {
+        if (NULL == tag)
+            return false;
+        if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag_size), const_cast<void*>(tag)))
+            THROW_OPENSSL_EXCEPTION("EVP_CTRL_GCM_SET_TAG");
+    }
+
+    // GCM的tag不匹配时EVP_CipherFinal_ex返回失败
+    if (1 != EVP_CipherFinal_ex(ctx, final_block, &outlen))
+    {
+        ERR_clear_error();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif // MOOON_HAVE_OPENSSL
+}
+
+void CAESCipher::encrypt(const void* iv, size_t iv_size, const std::string& in, std::string* out)
+{
+    const size_t tag_size = (mode_gcm == _mode)? gcm_tag_size: 0;
+    out->resize(in.size() + tag_size);
+
+    begin_encrypt(iv, iv_size);
+    if (!in.empty())
+        update(in.data(), in.size(), &(*out)[0]);
+    finish_encrypt((tag_size > 0)? &(*out)[in.size()]: NULL);
+}
+
+bool CAESCipher::decrypt(const void* iv, size_t iv_size, const std::string& in, std::string* out)
+{
+    const size_t tag_size = (mode_gcm == _mode)? gcm_tag_size: 0;
+    if (in.size() < tag_size)
+        return false;
+
+    const size_t size = in.size() - tag_size;
+    out->resize(size);
+    begin_decrypt(iv, iv_size);
+    if (size > 0)
+        update(in.data(), size, &(*out)[0]);
+    if (!finish_decrypt((tag_size > 0)? in.data()+size: NULL))
+    {
+        out->clear();
+        return false;
+    }
+    return true;
+}
+
 UTILS_NAMESPACE_END
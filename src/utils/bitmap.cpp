@@ -0,0 +1,460 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/bitmap.h"
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MOOON_BITMAP_SIMD 1
+#else
+#define MOOON_BITMAP_SIMD 0
+#endif
+UTILS_NAMESPACE_BEGIN
+
+////////////////////////////////////////////////////////////////////////////////
+// 标量实现，也用于处理向量实现剩下的不足一个向量的部分
+
+static void scalar_and_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+        dst[i] &= src[i];
+}
+
+static void scalar_or_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+        dst[i] |= src[i];
+}
+
+static void scalar_xor_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+        dst[i] ^= src[i];
+}
+
+static void scalar_and_not_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+        dst[i] &= ~src[i];
+}
+
+static size_t scalar_count_words(const uint64_t* words, size_t n)
+{
+    size_t count = 0;
+    for (size_t i=0; i<n; ++i)
+        count += __builtin_popcountll(words[i]);
+    return count;
+}
+
+static size_t scalar_and_count_words(const uint64_t* a, const uint64_t* b, size_t n)
+{
+    size_t count = 0;
+    for (size_t i=0; i<n; ++i)
+        count += __builtin_popcountll(a[i] & b[i]);
+    return count;
+}
+
+#if MOOON_BITMAP_SIMD == 1
+////////////////////////////////////////////////////////////////////////////////
+// POPCNT指令，位运算编译器已能用SSE2向量化，只有计数需要单独的实现
+
+__attribute__((target("popcnt")))
+static size_t popcnt_count_words(const uint64_t* words, size_t n)
+{
+    size_t count = 0;
+    for (size_t i=0; i<n; ++i)
+        count += __builtin_popcountll(words[i]);
+    return count;
+}
+
+__attribute__((target("popcnt")))
+static size_t popcnt_and_count_words(const uint64_t* a, const uint64_t* b, size_t n)
+{
+    size_t count = 0;
+    for (size_t i=0; i<n; ++i)
+        count += __builtin_popcountll(a[i] & b[i]);
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2，一次256位（4个字）
+
+#define BITMAP_AVX2_WORDS 4
+
+#define DEFINE_AVX2_BITWISE(name, op) \
+__attribute__((target("avx2"))) \
+static void avx2_##name##_words(uint64_t* dst, const uint64_t* src, size_t n) \
+{ \
+    size_t i = 0; \
+    for (; i+BITMAP_AVX2_WORDS<=n; i+=BITMAP_AVX2_WORDS) \
+    { \
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst+i)); \
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+i)); \
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+i), op); \
+    } \
+    scalar_##name##_words(dst+i, src+i, n-i); \
+}
+
+DEFINE_AVX2_BITWISE(and, _mm256_and_si256(x, y))
+DEFINE_AVX2_BITWISE(or, _mm256_or_si256(x, y))
+DEFINE_AVX2_BITWISE(xor, _mm256_xor_si256(x, y))
+DEFINE_AVX2_BITWISE(and_not, _mm256_andnot_si256(y, x))
+
+// 以半字节查表计数（Mula算法），每个字节的计数再用SAD横向累加到4个64位和中，
+// 比逐字POPCNT快，因为POPCNT每周期只能执行一条
+__attribute__((target("avx2")))
+static inline __m256i avx2_popcount(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    const __m256i low = _mm256_and_si256(v, low_mask);
+    const __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    const __m256i count = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+    return _mm256_sad_epu8(count, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline size_t avx2_sum(__m256i sum)
+{
+    return static_cast<size_t>(_mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1)
+                             + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3));
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t avx2_count_words(const uint64_t* words, size_t n)
+{
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i+BITMAP_AVX2_WORDS<=n; i+=BITMAP_AVX2_WORDS)
+        sum = _mm256_add_epi64(sum, avx2_popcount(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words+i))));
+    return avx2_sum(sum) + popcnt_count_words(words+i, n-i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t avx2_and_count_words(const uint64_t* a, const uint64_t* b, size_t n)
+{
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i+BITMAP_AVX2_WORDS<=n; i+=BITMAP_AVX2_WORDS)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+i));
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+i));
+        sum = _mm256_add_epi64(sum, avx2_popcount(_mm256_and_si256(x, y)));
+    }
+    return avx2_sum(sum) + popcnt_and_count_words(a+i, b+i, n-i);
+}
+#endif // MOOON_BITMAP_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+struct BitmapKernels
+{
+    CStringSimd::isa_t isa;
+    void (*and_words)(uint64_t* dst, const uint64_t* src, size_t n);
+    void (*or_words)(uint64_t* dst, const uint64_t* src, size_t n);
+    void (*xor_words)(uint64_t* dst, const uint64_t* src, size_t n);
+    void (*and_not_words)(uint64_t* dst, const uint64_t* src, size_t n);
+    size_t (*count_words)(const uint64_t* words, size_t n);
+    size_t (*and_count_words)(const uint64_t* a, const uint64_t* b, size_t n);
+};
+
+static const BitmapKernels scalar_kernels =
+{
+    CStringSimd::isa_scalar, scalar_and_words, scalar_or_words, scalar_xor_words,
+    scalar_and_not_words, scalar_count_words, scalar_and_count_words
+};
+
+#if MOOON_BITMAP_SIMD == 1
+static const BitmapKernels popcnt_kernels =
+{
+    CStringSimd::isa_sse42, scalar_and_words, scalar_or_words, scalar_xor_words,
+    scalar_and_not_words, popcnt_count_words, popcnt_and_count_words
+};
+
+static const BitmapKernels avx2_kernels =
+{
+    CStringSimd::isa_avx2, avx2_and_words, avx2_or_words, avx2_xor_words,
+    avx2_and_not_words, avx2_count_words, avx2_and_count_words
+};
+#endif // MOOON_BITMAP_SIMD
+
+static const BitmapKernels* select_kernels(CStringSimd::isa_t isa)
+{
+#if MOOON_BITMAP_SIMD == 1
+    if (isa >= CStringSimd::isa_avx2)
+        return &avx2_kernels;
+    if (isa >= CStringSimd::isa_sse42)
+        return &popcnt_kernels;
+#endif // MOOON_BITMAP_SIMD
+    return &scalar_kernels;
+}
+
+// 函数内的静态变量，保证在其它全局对象的构造函数中使用时也已初始化，
+// SSE4.2的CPU都支持POPCNT，因此沿用CStringSimd的指令集判断
+static const BitmapKernels*& kernels()
+{
+    static const BitmapKernels* selected = select_kernels(CStringSimd::get_supported_isa());
+    return selected;
+}
+
+// [begin&63, 64)为1的掩码
+static inline uint64_t head_mask(size_t begin)
+{
+    return ~UINT64_C(0) << (begin & 63);
+}
+
+// [0, ((end-1)&63)]为1的掩码，end不能为0
+static inline uint64_t tail_mask(size_t end)
+{
+    return ~UINT64_C(0) >> (63 - ((end - 1) & 63));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CBitmap::CBitmap(size_t bit_number)
+    : _bit_number(bit_number), _words((bit_number + 63) / 64, 0)
+{
+}
+
+void CBitmap::resize(size_t bit_number)
+{
+    _words.resize((bit_number + 63) / 64, 0);
+    _bit_number = bit_number;
+    trim();
+}
+
+void CBitmap::set(size_t begin, size_t end)
+{
+    if (begin >= end)
+        return;
+
+    const size_t first = begin >> 6;
+    const size_t last = (end - 1) >> 6;
+    if (first == last)
+    {
+        _words[first] |= head_mask(begin) & tail_mask(end);
+    }
+    else
+    {
+        _words[first] |= head_mask(begin);
+        for (size_t i=first+1; i<last; ++i)
+            _words[i] = ~UINT64_C(0);
+        _words[last] |= tail_mask(end);
+    }
+}
+
+void CBitmap::reset(size_t begin, size_t end)
+{
+    if (begin >= end)
+        return;
+
+    const size_t first = begin >> 6;
+    const size_t last = (end - 1) >> 6;
+    if (first == last)
+    {
+        _words[first] &= ~(head_mask(begin) & tail_mask(end));
+    }
+    else
+    {
+        _words[first] &= ~head_mask(begin);
+        if (last > first + 1)
+            memset(&_words[first+1], 0, (last - first - 1) * sizeof(uint64_t));
+        _words[last] &= ~tail_mask(end);
+    }
+}
+
+void CBitmap::set_all()
+{
+    if (!_words.empty())
+    {
+        memset(&_words[0], 0xFF, _words.size() * sizeof(uint64_t));
+        trim();
+    }
+}
+
+void CBitmap::reset_all()
+{
+    if (!_words.empty())
+        memset(&_words[0], 0, _words.size() * sizeof(uint64_t));
+}
+
+size_t CBitmap::count() const
+{
+    return _words.empty()? 0: kernels()->count_words(&_words[0], _words.size());
+}
+
+size_t CBitmap::count(size_t begin, size_t end) const
+{
+    if (begin >= end)
+        return 0;
+
+    const size_t first = begin >> 6;
+    const size_t last = (end - 1) >> 6;
+    if (first == last)
+        return __builtin_popcountll(_words[first] & head_mask(begin) & tail_mask(end));
+
+    size_t number = __builtin_popcountll(_words[first] & head_mask(begin))
+                  + __builtin_popcountll(_words[last] & tail_mask(end));
+    if (last > first + 1)
+        number += kernels()->count_words(&_words[first+1], last - first - 1);
+    return number;
+}
+
+bool CBitmap::any() const
+{
+    for (std::vector<uint64_t>::size_type i=0; i<_words.size(); ++i)
+    {
+        if (_words[i] != 0)
+            return true;
+    }
+
+    return false;
+}
+
+size_t CBitmap::find_first_set(size_t from) const
+{
+    if (from >= _bit_number)
+        return npos;
+
+    size_t i = from >> 6;
+    uint64_t word = _words[i] & head_mask(from);
+    for (;;)
+    {
+        if (word != 0)
+            return (i << 6) + __builtin_ctzll(word);
+        if (++i == _words.size())
+            return npos;
+        word = _words[i];
+    }
+}
+
+size_t CBitmap::find_first_zero(size_t from) const
+{
+    if (from >= _bit_number)
+        return npos;
+
+    size_t i = from >> 6;
+    uint64_t word = ~_words[i] & head_mask(from);
+    for (;;)
+    {
+        if (word != 0)
+        {
+            // 最后一个字超出位数的位总是0，取反后为1，须排除
+            const size_t position = (i << 6) + __builtin_ctzll(word);
+            return (position < _bit_number)? position: npos;
+        }
+        if (++i == _words.size())
+            return npos;
+        word = ~_words[i];
+    }
+}
+
+CBitmap& CBitmap::operator &=(const CBitmap& other)
+{
+    const size_t n = (_words.size() < other._words.size())? _words.size(): other._words.size();
+    if (n > 0)
+        kernels()->and_words(&_words[0], &other._words[0], n);
+    return *this;
+}
+
+CBitmap& CBitmap::operator |=(const CBitmap& other)
+{
+    const size_t n = (_words.size() < other._words.size())? _words.size(): other._words.size();
+    if (n > 0)
+        kernels()->or_words(&_words[0], &other._words[0], n);
+    trim();
+    return *this;
+}
+
+CBitmap& CBitmap::operator ^=(const CBitmap& other)
+{
+    const size_t n = (_words.size() < other._words.size())? _words.size(): other._words.size();
+    if (n > 0)
+        kernels()->xor_words(&_words[0], &other._words[0], n);
+    trim();
+    return *this;
+}
+
+CBitmap& CBitmap::and_not(const CBitmap& other)
+{
+    const size_t n = (_words.size() < other._words.size())? _words.size(): other._words.size();
+    if (n > 0)
+        kernels()->and_not_words(&_words[0], &other._words[0], n);
+    return *this;
+}
+
+size_t CBitmap::and_count(const CBitmap& other) const
+{
+    const size_t n = (_words.size() < other._words.size())? _words.size(): other._words.size();
+    return (0 == n)? 0: kernels()->and_count_words(&_words[0], &other._words[0], n);
+}
+
+bool CBitmap::operator ==(const CBitmap& other) const
+{
+    return (_bit_number == other._bit_number) && (_words == other._words);
+}
+
+void CBitmap::and_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    kernels()->and_words(dst, src, n);
+}
+
+void CBitmap::or_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    kernels()->or_words(dst, src, n);
+}
+
+void CBitmap::xor_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    kernels()->xor_words(dst, src, n);
+}
+
+void CBitmap::and_not_words(uint64_t* dst, const uint64_t* src, size_t n)
+{
+    kernels()->and_not_words(dst, src, n);
+}
+
+size_t CBitmap::count_words(const uint64_t* words, size_t n)
+{
+    return kernels()->count_words(words, n);
+}
+
+size_t CBitmap::and_count_words(const uint64_t* a, const uint64_t* b, size_t n)
+{
+    return kernels()->and_count_words(a, b, n);
+}
+
+CStringSimd::isa_t CBitmap::get_isa()
+{
+    return kernels()->isa;
+}
+
+CStringSimd::isa_t CBitmap::set_isa(CStringSimd::isa_t isa)
+{
+    const CStringSimd::isa_t supported_isa = CStringSimd::get_supported_isa();
+    kernels() = select_kernels((isa > supported_isa)? supported_isa: isa);
+    return kernels()->isa;
+}
+
+void CBitmap::trim()
+{
+    if ((_bit_number & 63) != 0)
+        _words.back() &= tail_mask(_bit_number);
+}
+
+UTILS_NAMESPACE_END
@@ -0,0 +1,307 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/bloom_filter.h"
+#include "utils/bitmap.h"
+#include <math.h>
+#include <string.h>
+UTILS_NAMESPACE_BEGIN
+
+#define BLOOM_FILTER_MAX_HASHES 16
+#define BLOOM_FILTER_MAX_BLOCKS UINT32_MAX
+
+CBloomFilter::CBloomFilter()
+    : CSketchStorage(sketch_bloom_filter), _block_number(0), _hash_number(0)
+{
+}
+
+CBloomFilter::CBloomFilter(uint64_t expected_number, double fpp)
+    : CSketchStorage(sketch_bloom_filter)
+{
+    if (0 == expected_number)
+        expected_number = 1;
+    if ((fpp <= 0) || (fpp >= 1))
+        fpp = 0.01;
+
+    // 标准布隆过滤器的最优位数和哈希数，分块后各块的负载不均，多给15%的位弥补误判率的上升
+    const double bits_per_key = -log(fpp) / (M_LN2 * M_LN2) * 1.15;
+    const double blocks = ceil(bits_per_key * static_cast<double>(expected_number) / static_cast<double>(BLOCK_BITS));
+    const double hashes = floor(-log(fpp) / M_LN2 + 0.5);
+
+    _block_number = static_cast<uint32_t>((blocks > BLOOM_FILTER_MAX_BLOCKS)? BLOOM_FILTER_MAX_BLOCKS: blocks);
+    _hash_number = static_cast<uint32_t>((hashes < 1)? 1: ((hashes > BLOOM_FILTER_MAX_HASHES)? BLOOM_FILTER_MAX_HASHES: hashes));
+    _params[0] = _block_number;
+    _params[1] = _hash_number;
+    create(static_cast<size_t>(_block_number) * BLOCK_BITS / 8);
+}
+
+// 高32位选块，低32位和再混合的32位以双重哈希生成块内的各个位置，取其高9位
+#define FOR_EACH_BLOOM_BIT(hash, statement) \
+    do { \
+        const uint32_t h1 = static_cast<uint32_t>(hash); \
+        const uint32_t h2 = static_cast<uint32_t>(CHashUtils::mix64(hash) >> 32) | 1; \
+        for (uint32_t i=0; i<_hash_number; ++i) \
+        { \
+            const uint32_t bit = (h1 + i * h2) >> 23; \
+            const uint64_t mask = UINT64_C(1) << (bit & 63); \
+            uint64_t& word = block[bit >> 6]; \
+            statement; \
+        } \
+    } while (false)
+
+void CBloomFilter::add_hash(uint64_t hash)
+{
+    uint64_t* block = get_block(hash);
+    FOR_EACH_BLOOM_BIT(hash, word |= mask);
+}
+
+bool CBloomFilter::contains_hash(uint64_t hash) const
+{
+    uint64_t* block = get_block(hash);
+    FOR_EACH_BLOOM_BIT(hash, if (0 == (word & mask)) return false);
+    return true;
+}
+
+bool CBloomFilter::test_and_add_hash(uint64_t hash)
+{
+    uint64_t* block = get_block(hash);
+    bool existed = true;
+    FOR_EACH_BLOOM_BIT(hash, if (0 == (word & mask)) { existed = false; word |= mask; });
+    return existed;
+}
+
+bool CBloomFilter::merge(const CBloomFilter& other)
+{
+    if (!same_shape(other))
+        return false;
+
+    CBitmap::or_words(reinterpret_cast<uint64_t*>(_data), reinterpret_cast<const uint64_t*>(other._data), _data_size / 8);
+    return true;
+}
+
+double CBloomFilter::estimate_fpp() const
+{
+    const size_t words = _data_size / 8;
+    if (0 == words)
+        return 0;
+
+    const double fill = static_cast<double>(CBitmap::count_words(reinterpret_cast<const uint64_t*>(_data), words)) / (words * 64);
+    return pow(fill, static_cast<double>(_hash_number));
+}
+
+bool CBloomFilter::restore(const uint64_t* params, size_t data_size)
+{
+    const uint64_t block_number = params[0];
+    const uint64_t hash_number = params[1];
+    if ((block_number < 1) || (block_number > BLOOM_FILTER_MAX_BLOCKS) || (hash_number < 1) || (hash_number > BLOOM_FILTER_MAX_HASHES))
+        return false;
+    if (data_size != block_number * BLOCK_BITS / 8)
+        return false;
+
+    _block_number = static_cast<uint32_t>(block_number);
+    _hash_number = static_cast<uint32_t>(hash_number);
+    return true;
+}
+
+uint64_t* CBloomFilter::get_block(uint64_t hash) const
+{
+    return reinterpret_cast<uint64_t*>(_data) + static_cast<size_t>(CHashUtils::reduce(hash, _block_number)) * BLOCK_WORDS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 被踢出后无处存放的指纹记在meta[1]：最高位为1表示有，低16位为指纹，其余为桶的下标
+
+#define CUCKOO_VICTIM_FLAG (UINT64_C(1) << 63)
+#define CUCKOO_MAX_BUCKETS (UINT64_C(1) << 40)
+
+CCuckooFilter::CCuckooFilter()
+    : CSketchStorage(sketch_cuckoo_filter), _bucket_mask(0)
+{
+}
+
+CCuckooFilter::CCuckooFilter(uint64_t capacity)
+    : CSketchStorage(sketch_cuckoo_filter)
+{
+    const uint64_t buckets = (capacity / BUCKET_SLOTS) * 100 / 95 + 1;
+    uint64_t bucket_number = 1;
+    while ((bucket_number < buckets) && (bucket_number < CUCKOO_MAX_BUCKETS))
+        bucket_number <<= 1;
+
+    _bucket_mask = bucket_number - 1;
+    _params[0] = bucket_number;
+    create(16 + static_cast<size_t>(bucket_number) * BUCKET_SLOTS * sizeof(uint16_t));
+}
+
+bool CCuckooFilter::add_hash(uint64_t hash)
+{
+    uint64_t* meta = get_meta();
+    if (0 != (meta[1] & CUCKOO_VICTIM_FLAG))
+        return false;
+
+    place(hash & _bucket_mask, get_fingerprint(hash), hash);
+    ++meta[0];
+    return true;
+}
+
+bool CCuckooFilter::contains_hash(uint64_t hash) const
+{
+    const uint16_t fingerprint = get_fingerprint(hash);
+    const uint64_t index = hash & _bucket_mask;
+    const uint64_t alternate = get_alternate(index, fingerprint);
+    const uint64_t victim = get_meta()[1];
+
+    if (0 != (victim & CUCKOO_VICTIM_FLAG))
+    {
+        const uint64_t victim_index = (victim & ~CUCKOO_VICTIM_FLAG) >> 16;
+        if ((static_cast<uint16_t>(victim) == fingerprint) && ((victim_index == index) || (victim_index == alternate)))
+            return true;
+    }
+    return bucket_contains(index, fingerprint) || bucket_contains(alternate, fingerprint);
+}
+
+bool CCuckooFilter::remove_hash(uint64_t hash)
+{
+    uint64_t* meta = get_meta();
+    const uint16_t fingerprint = get_fingerprint(hash);
+    const uint64_t index = hash & _bucket_mask;
+    const uint64_t alternate = get_alternate(index, fingerprint);
+
+    if (remove_from(index, fingerprint) || remove_from(alternate, fingerprint))
+    {
+        --meta[0];
+
+        // 腾出了位置，重新放置无处存放的指纹，仍放不下时再次记下
+        if (0 != (meta[1] & CUCKOO_VICTIM_FLAG))
+        {
+            const uint64_t victim = meta[1];
+            meta[1] = 0;
+            place((victim & ~CUCKOO_VICTIM_FLAG) >> 16, static_cast<uint16_t>(victim), hash);
+        }
+        return true;
+    }
+
+    const uint64_t victim = meta[1];
+    if (0 != (victim & CUCKOO_VICTIM_FLAG))
+    {
+        const uint64_t victim_index = (victim & ~CUCKOO_VICTIM_FLAG) >> 16;
+        if ((static_cast<uint16_t>(victim) == fingerprint) && ((victim_index == index) || (victim_index == alternate)))
+        {
+            meta[1] = 0;
+            --meta[0];
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t CCuckooFilter::size() const
+{
+    return get_meta()[0];
+}
+
+// 放入候选桶之一，都满时随机踢出一个指纹到它的另一个桶，
+// 踢出MAX_KICKS次后仍无处存放的指纹记在meta[1]，之后的add都失败，直到有删除
+void CCuckooFilter::place(uint64_t index, uint16_t fingerprint, uint64_t random)
+{
+    if (insert_into(index, fingerprint))
+        return;
+    index = get_alternate(index, fingerprint);
+    if (insert_into(index, fingerprint))
+        return;
+
+    for (int kicks=0; kicks<MAX_KICKS; ++kicks)
+    {
+        random = random * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+        uint16_t* bucket = get_bucket(index);
+        const uint32_t slot = static_cast<uint32_t>(random >> 62);
+        const uint16_t victim = bucket[slot];
+        bucket[slot] = fingerprint;
+
+        fingerprint = victim;
+        index = get_alternate(index, fingerprint);
+        if (insert_into(index, fingerprint))
+            return;
+    }
+
+    get_meta()[1] = CUCKOO_VICTIM_FLAG | (index << 16) | fingerprint;
+}
+
+// 另一个桶由桶下标和指纹异或得到，两个桶互为对方的另一个桶
+uint64_t CCuckooFilter::get_alternate(uint64_t index, uint16_t fingerprint) const
+{
+    return (index ^ CHashUtils::mix64(fingerprint)) & _bucket_mask;
+}
+
+bool CCuckooFilter::insert_into(uint64_t index, uint16_t fingerprint)
+{
+    uint16_t* bucket = get_bucket(index);
+    for (int i=0; i<BUCKET_SLOTS; ++i)
+    {
+        if (0 == bucket[i])
+        {
+            bucket[i] = fingerprint;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CCuckooFilter::remove_from(uint64_t index, uint16_t fingerprint)
+{
+    uint16_t* bucket = get_bucket(index);
+    for (int i=0; i<BUCKET_SLOTS; ++i)
+    {
+        if (fingerprint == bucket[i])
+        {
+            bucket[i] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CCuckooFilter::bucket_contains(uint64_t index, uint16_t fingerprint) const
+{
+    // 一个桶正好一个64位字，一次读入比较
+    uint64_t word;
+    memcpy(&word, get_bucket(index), sizeof(word));
+    const uint64_t pattern = UINT64_C(0x0001000100010001) * fingerprint;
+    const uint64_t diff = word ^ pattern;
+    return 0 != ((diff - UINT64_C(0x0001000100010001)) & ~diff & UINT64_C(0x8000800080008000));
+}
+
+// 指纹取哈希中不用于选桶的位，0表示空位，不作为指纹
+uint16_t CCuckooFilter::get_fingerprint(uint64_t hash)
+{
+    const uint16_t fingerprint = static_cast<uint16_t>(hash >> 48);
+    return (0 == fingerprint)? 1: fingerprint;
+}
+
+bool CCuckooFilter::restore(const uint64_t* params, size_t data_size)
+{
+    const uint64_t bucket_number = params[0];
+    if ((bucket_number < 1) || (bucket_number > CUCKOO_MAX_BUCKETS) || (0 != (bucket_number & (bucket_number - 1))))
+        return false;
+    if (data_size != 16 + bucket_number * BUCKET_SLOTS * sizeof(uint16_t))
+        return false;
+
+    _bucket_mask = bucket_number - 1;
+    return true;
+}
+
+UTILS_NAMESPACE_END
@@ -17,121 +17,466 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include "utils/charset_utils.h"
+#include "utils/string_simd.h"
+#include "utils/string_utils.h"
+#include <algorithm>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h> // x86_64都支持SSE2，不需要按CPU选择
+#define MOOON_CHARSET_SSE2 1
+#else
+#define MOOON_CHARSET_SSE2 0
+#endif
 UTILS_NAMESPACE_BEGIN
 
-// 传递给do_convert的in_buf，所有字节数（in_buf_size指定）都是可以转换成功的
-static int do_convert(iconv_t cd, const char* from, size_t from_size, std::string* to)
+// 每个线程最多缓存的iconv_t个数，超出时关闭最早打开的
+#define MAX_CACHED_ICONV 8
+
+// 连续的ASCII达到这个长度才从交给iconv的段中断开，夹杂在非ASCII中的少量ASCII仍由iconv转换
+#define MIN_ASCII_RUN 16
+
+// 多字节字符的最大长度（gb18030和utf-8均为4）
+#define MAX_CHAR_BYTES 4
+
+struct IconvEntry
 {
-    char* in_buf_ptr = const_cast<char*>(from);
-    size_t in_bytes_left = from_size;
-    size_t out_bytes = in_bytes_left*3 + 1;
-    size_t out_bytes_left = out_bytes;
-    std::string out(out_bytes_left, '\0');
-    char* out_buf_start = const_cast<char*>(out.c_str());
-    char* out_buf_ptr = out_buf_start;
+    std::string from_charset;
+    std::string to_charset;
+    iconv_t cd;
+    bool ascii_compatible; // 源和目标字符集是否都兼容ASCII，即ASCII字符转换前后不变
+};
 
-    int bytes = iconv(cd, &in_buf_ptr, &in_bytes_left, &out_buf_ptr, &out_bytes_left);
-    if (-1 == bytes)
-        return errno;
+typedef std::vector<IconvEntry> IconvCache;
 
-    to->assign(out_buf_start, out_bytes-out_bytes_left);
-    return 0;
+static pthread_key_t sg_iconv_key;
+static pthread_once_t sg_iconv_once = PTHREAD_ONCE_INIT;
+static __thread IconvCache* sg_iconv_cache = NULL;
+
+static void delete_iconv_cache(void* param)
+{
+    IconvCache* iconv_cache = static_cast<IconvCache*>(param);
+    for (IconvCache::size_type i=0; i<iconv_cache->size(); ++i)
+        (void)iconv_close((*iconv_cache)[i].cd);
+    delete iconv_cache;
 }
 
-void CCharsetUtils::convert(const std::string& from_charset, const std::string& to_charset,
-                            const std::string& from, std::string* to,
-                            bool ignore_error, bool skip_error)
+static void create_iconv_key()
 {
-    std::string result; // 用来保存处理后的内容
-    char* in_buf = const_cast<char*>(from.c_str());
-    size_t in_bytes = from.size();   // 需要处理的总字节数
-    size_t in_bytes_left = in_bytes; // 剩余的未被处理的字节数
-    iconv_t cd = iconv_open(to_charset.c_str(), from_charset.c_str());
+    (void)pthread_key_create(&sg_iconv_key, delete_iconv_cache);
+}
 
-    if ((iconv_t)(-1) == cd)
+// 忽略大小写、“-”和“_”，以及“//IGNORE”等后缀
+static bool is_ascii_compatible(const std::string& charset)
+{
+    static const char* ascii_charsets[] =
+    {
+        "utf8", "gbk", "gb2312", "gb18030", "cp936", "euccn", "big5", "ascii", "usascii", "latin1", "iso88591", NULL
+    };
+
+    std::string name;
+    for (std::string::size_type i=0; (i<charset.size()) && (charset[i]!='/'); ++i)
+    {
+        if ((charset[i] != '-') && (charset[i] != '_'))
+            name.push_back(static_cast<char>(tolower(static_cast<unsigned char>(charset[i]))));
+    }
+    for (int i=0; ascii_charsets[i]!=NULL; ++i)
+    {
+        if (name == ascii_charsets[i])
+            return true;
+    }
+
+    return false;
+}
+
+// 得到本线程缓存的iconv_t，并复位其转换状态
+static const IconvEntry* get_iconv(const std::string& from_charset, const std::string& to_charset)
+{
+    if (NULL == sg_iconv_cache)
+    {
+        (void)pthread_once(&sg_iconv_once, create_iconv_key);
+        sg_iconv_cache = new IconvCache;
+        (void)pthread_setspecific(sg_iconv_key, sg_iconv_cache);
+    }
+
+    for (IconvCache::size_type i=0; i<sg_iconv_cache->size(); ++i)
+    {
+        const IconvEntry& entry = (*sg_iconv_cache)[i];
+        if ((entry.from_charset == from_charset) && (entry.to_charset == to_charset))
+        {
+            (void)iconv(entry.cd, NULL, NULL, NULL, NULL);
+            return &entry;
+        }
+    }
+
+    IconvEntry entry;
+    entry.cd = iconv_open(to_charset.c_str(), from_charset.c_str());
+    if ((iconv_t)(-1) == entry.cd)
     {
         THROW_EXCEPTION(strerror(errno), errno);
     }
+    if (sg_iconv_cache->size() >= MAX_CACHED_ICONV)
+    {
+        (void)iconv_close(sg_iconv_cache->front().cd);
+        sg_iconv_cache->erase(sg_iconv_cache->begin());
+    }
+
+    entry.from_charset = from_charset;
+    entry.to_charset = to_charset;
+    entry.ascii_compatible = is_ascii_compatible(from_charset) && is_ascii_compatible(to_charset);
+    sg_iconv_cache->push_back(entry);
+    return &sg_iconv_cache->back();
+}
+
+// 转换结果的输出位置，可以是自动增长的std::string，也可以是调用者提供的固定大小缓冲区
+class COutput
+{
+public:
+    COutput(std::string* str, size_t capacity)
+        : _str(str), _capacity(capacity), _size(0)
+    {
+        _str->resize(_capacity);
+        _buffer = const_cast<char*>(_str->data());
+    }
+
+    COutput(char* buffer, size_t capacity)
+        : _str(NULL), _buffer(buffer), _capacity(capacity), _size(0)
+    {
+    }
+
+    char* tail() const { return _buffer + _size; }
+    size_t room() const { return _capacity - _size; }
+    size_t size() const { return _size; }
+    void commit(size_t size) { _size += size; }
+
+    void append(const char* data, size_t size)
+    {
+        if (room() < size)
+            grow(size);
+        memcpy(tail(), data, size);
+        _size += size;
+    }
+
+    // 保证至少还有size字节的空间，固定大小的缓冲区不能增长
+    void grow(size_t size)
+    {
+        if (NULL == _str)
+        {
+            THROW_EXCEPTION(strerror(E2BIG), E2BIG);
+        }
+
+        _capacity = std::max(_capacity*2, _size+size);
+        _str->resize(_capacity);
+        _buffer = const_cast<char*>(_str->data());
+    }
+
+    void finish()
+    {
+        if (_str != NULL)
+            _str->resize(_size);
+    }
+
+private:
+    std::string* _str;
+    char* _buffer;
+    size_t _capacity;
+    size_t _size;
+};
+
+// 从from开始找长度不小于MIN_ASCII_RUN的连续ASCII，找不到返回end
+static const char* find_ascii_run(const char* from, const char* end)
+{
+    const char* str = from;
+    while (str < end)
+    {
+        while ((str < end) && (static_cast<unsigned char>(*str) >= 0x80))
+            ++str;
+
+        const size_t ascii_size = CStringSimd::count_leading_ascii(str, end-str);
+        if ((ascii_size >= MIN_ASCII_RUN) || (str+ascii_size == end))
+            return str;
+        str += ascii_size;
+    }
+
+    return end;
+}
+
+// 用iconv转换[from, segment_end)，end为整个输入的结尾
+// 返回未被转换部分的起始位置，遇到可忽略的错误时已跳过出错的字节
+static const char* convert_segment(iconv_t cd, const char* from, const char* segment_end, const char* end,
+                                   COutput* output, bool ignore_error, bool skip_error)
+{
+    char* in_buf = const_cast<char*>(from);
+    size_t in_bytes_left = segment_end - from;
+
     while (in_bytes_left > 0)
     {
-        int errcode;
-        size_t out_bytes = in_bytes_left * 3 + 1; // 保证足够大
-        size_t out_bytes_left = out_bytes;
-        std::string out(out_bytes_left, '\0');
-        char* out_buf = const_cast<char*>(out.c_str());
-        char* out_buf_start = out_buf;
-        char* in_buf_start = in_buf;
-
-        // 如果成功，返回值bytes为0
-        // 如果成功，in_buf指向in的结尾符，即'\0'，同时in_bytes_left值为0
-        // 如果失败，in_buf指向未能转换的起始地址，而in_bytes_left值为剩余的未被转换的（可能含有可转换的）字节数
-        // 如果成功，则out_bytes-out_bytes_left值为转换后的字节数
-        // 如果成功，则out_buf_start存储了被转换后的结果，有效长度为out_bytes-out_bytes_left
-        int bytes = iconv(cd, &in_buf, &in_bytes_left, &out_buf, &out_bytes_left);
-        if (bytes != -1)
-        {
-            result.append(out_buf_start, out_bytes-out_bytes_left);
+        char* out_buf = output->tail();
+        size_t out_bytes_left = output->room();
+
+        // 如果成功，in_bytes_left值为0
+        // 如果失败，in_buf指向未能转换的起始地址，它之前的部分已转换到out_buf中
+        const size_t bytes = iconv(cd, &in_buf, &in_bytes_left, &out_buf, &out_bytes_left);
+        const int errcode = errno;
+        output->commit(output->room() - out_bytes_left);
+        if (bytes != static_cast<size_t>(-1))
             break;
+
+        // E2BIG  There is not sufficient room at *outbuf.
+        if (E2BIG == errcode)
+        {
+            output->grow(in_bytes_left*2 + MAX_CHAR_BYTES);
+        }
+        // 段在多字节字符的中间断开（如gbk的第二个字节落在ASCII范围），将段延长后继续
+        else if ((EINVAL == errcode) && (segment_end < end))
+        {
+            segment_end = std::min(segment_end+MAX_CHAR_BYTES, end);
+            in_bytes_left = segment_end - in_buf;
         }
-        else if (!ignore_error)
+        // EILSEQ An invalid multibyte sequence has been encountered in the input.
+        // EINVAL An incomplete multibyte sequence has been encountered in the input.
+        else if (!ignore_error || ((errcode != EINVAL) && (errcode != EILSEQ)))
         {
-            errcode = errno;
-            iconv_close(cd);
             THROW_EXCEPTION(strerror(errcode), errcode);
         }
         else
         {
-            // EILSEQ An invalid multibyte sequence has been encountered in the input.
-            // EINVAL An incomplete multibyte sequence has been encountered in the input.
-            if ((errno != EINVAL) &&
-                (errno != EILSEQ))
+            // skip_error决定未能被转换的是否出现在结果当中
+            if (!skip_error)
+                output->append(in_buf, 1);
+
+            (void)iconv(cd, NULL, NULL, NULL, NULL);
+            return in_buf + 1;
+        }
+    }
+
+    return in_buf;
+}
+
+static void do_convert(const IconvEntry* entry, const char* from, size_t from_size,
+                       COutput* output, bool ignore_error, bool skip_error)
+{
+    const char* end = from + from_size;
+    const char* in_buf = from;
+
+    while (in_buf < end)
+    {
+        const char* segment_end = end;
+        if (entry->ascii_compatible)
+        {
+            // 此时in_buf总是在字符的边界上
+            const size_t ascii_size = CStringSimd::count_leading_ascii(in_buf, end-in_buf);
+            if (ascii_size > 0)
             {
-                // E2BIG  There is not sufficient room at *outbuf.
-                errcode = errno;
-                iconv_close(cd);
-                THROW_EXCEPTION(strerror(errcode), errcode);
+                output->append(in_buf, ascii_size);
+                in_buf += ascii_size;
+                continue;
             }
-            else
-            {
-                // in_buf之前部分是可以转换的
-                if (in_buf != in_buf_start)
-                {
-                    std::string str;
-                    errcode = do_convert(cd, in_buf_start, in_buf-in_buf_start, &str);
-                    if (errcode != 0)
-                    {
-                        iconv_close(cd);
-                        THROW_EXCEPTION(strerror(errcode), errcode);
-                    }
-
-                    result.append(str);
-                }
 
-                // skip_error决定未能被转换的是否出现在结果当中
-                if (!skip_error)
-                {
-                    result.append(in_buf, 1);
-                }
+            segment_end = find_ascii_run(in_buf, end);
+        }
 
-                // 往前推进
-                --in_bytes_left; // 将导致while语句结束
-                ++in_buf;
-            }
+        in_buf = convert_segment(entry->cd, in_buf, segment_end, end, output, ignore_error, skip_error);
+    }
+
+    // 有状态的目标字符集需要输出复位序列
+    for (;;)
+    {
+        char* out_buf = output->tail();
+        size_t out_bytes_left = output->room();
+        const size_t bytes = iconv(entry->cd, NULL, NULL, &out_buf, &out_bytes_left);
+        const int errcode = errno;
+        output->commit(output->room() - out_bytes_left);
+        if (bytes != static_cast<size_t>(-1))
+            break;
+        if (errcode != E2BIG)
+            THROW_EXCEPTION(strerror(errcode), errcode);
+        output->grow(MAX_CHAR_BYTES*2);
+    }
+
+    output->finish();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 不经过iconv的转换
+
+// GBK双字节字符的首字节为[0x81, 0xFE]，第二个字节为[0x40, 0xFE]
+#define GBK_LEAD_MIN 0x81
+#define GBK_LEAD_MAX 0xFE
+#define GBK_TRAIL_MIN 0x40
+#define GBK_TRAIL_MAX 0xFE
+#define GBK_TRAIL_NUMBER (GBK_TRAIL_MAX - GBK_TRAIL_MIN + 1)
+#define GBK_DOUBLE_NUMBER ((GBK_LEAD_MAX - GBK_LEAD_MIN + 1) * GBK_TRAIL_NUMBER)
+
+// GBK双字节字符对应的Unicode，之后是0x80至0xFF单字节的（glibc的GBK将0x80转成欧元符号），
+// 0表示不能转换，生成后不再修改
+static uint16_t* sg_gbk_table = NULL;
+static pthread_once_t sg_gbk_once = PTHREAD_ONCE_INIT;
+
+// 只接受全部输入转成一个UTF-16单元的，否则返回0
+static uint16_t iconv_to_utf16(iconv_t cd, const char* in, size_t in_size)
+{
+    unsigned char out[8];
+    char* in_buf = const_cast<char*>(in);
+    size_t in_bytes_left = in_size;
+    char* out_buf = reinterpret_cast<char*>(out);
+    size_t out_bytes_left = sizeof(out);
+
+    const size_t bytes = iconv(cd, &in_buf, &in_bytes_left, &out_buf, &out_bytes_left);
+    if ((bytes != static_cast<size_t>(-1)) && (0 == in_bytes_left) && (sizeof(out)-out_bytes_left == 2))
+        return static_cast<uint16_t>(out[0] | (out[1] << 8));
+
+    (void)iconv(cd, NULL, NULL, NULL, NULL);
+    return 0;
+}
+
+// 由iconv逐个转换所有的单字节和双字节组合得到，所以和iconv的GBK转换结果完全相同，
+// 没有GBK的gconv模块时表为NULL，仍使用iconv转换
+static void create_gbk_table()
+{
+    iconv_t cd = iconv_open("UTF-16LE", "GBK");
+    if ((iconv_t)(-1) == cd)
+        return;
+
+    uint16_t* table = new uint16_t[GBK_DOUBLE_NUMBER + 0x80];
+    for (int lead=GBK_LEAD_MIN; lead<=GBK_LEAD_MAX; ++lead)
+    {
+        for (int trail=GBK_TRAIL_MIN; trail<=GBK_TRAIL_MAX; ++trail)
+        {
+            const char in[2] = { static_cast<char>(lead), static_cast<char>(trail) };
+            table[(lead - GBK_LEAD_MIN) * GBK_TRAIL_NUMBER + (trail - GBK_TRAIL_MIN)] = iconv_to_utf16(cd, in, sizeof(in));
         }
     }
+    for (int c=0x80; c<=0xFF; ++c)
+    {
+        const char in = static_cast<char>(c);
+        table[GBK_DOUBLE_NUMBER + (c - 0x80)] = iconv_to_utf16(cd, &in, 1);
+    }
+
+    (void)iconv_close(cd);
+    sg_gbk_table = table;
+}
+
+static const uint16_t* get_gbk_table()
+{
+    (void)pthread_once(&sg_gbk_once, create_gbk_table);
+    return sg_gbk_table;
+}
 
-    if (-1 == iconv_close(cd))
+// 将不超过U+FFFF的code编码成UTF-8，返回字节数
+static inline size_t encode_utf8(uint32_t code, char* utf8)
+{
+    if (code < 0x80)
     {
-        THROW_EXCEPTION(strerror(errno), errno);
+        utf8[0] = static_cast<char>(code);
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        utf8[0] = static_cast<char>(0xC0 | (code >> 6));
+        utf8[1] = static_cast<char>(0x80 | (code & 0x3F));
+        return 2;
+    }
+
+    utf8[0] = static_cast<char>(0xE0 | (code >> 12));
+    utf8[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    utf8[2] = static_cast<char>(0x80 | (code & 0x3F));
+    return 3;
+}
+
+// 出错的处理同convert_segment：不忽略时抛出异常，忽略时跳过一个字节
+static void fast_gbk_to_utf8(const uint16_t* gbk_table, const char* from, size_t from_size,
+                             COutput* output, bool ignore_error, bool skip_error)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(from);
+    size_t i = 0;
+
+    while (i < from_size)
+    {
+        const size_t ascii_size = CStringSimd::count_leading_ascii(from+i, from_size-i);
+        if (ascii_size > 0)
+        {
+            output->append(from+i, ascii_size);
+            i += ascii_size;
+            continue;
+        }
+
+        const unsigned char lead = bytes[i];
+        const bool is_lead = (lead >= GBK_LEAD_MIN) && (lead <= GBK_LEAD_MAX);
+        uint16_t code = 0;
+        if (is_lead && (i+1 < from_size) && (bytes[i+1] >= GBK_TRAIL_MIN) && (bytes[i+1] <= GBK_TRAIL_MAX))
+            code = gbk_table[(lead - GBK_LEAD_MIN) * GBK_TRAIL_NUMBER + (bytes[i+1] - GBK_TRAIL_MIN)];
+        if (code != 0)
+        {
+            i += 2;
+        }
+        else
+        {
+            code = gbk_table[GBK_DOUBLE_NUMBER + (lead - 0x80)];
+            if (code != 0)
+                i += 1;
+        }
+
+        if (0 == code)
+        {
+            // 结尾只有首字节时同iconv，为不完整的字符
+            const int errcode = (is_lead && (i+1 == from_size))? EINVAL: EILSEQ;
+            if (!ignore_error)
+                THROW_EXCEPTION(strerror(errcode), errcode);
+            if (!skip_error)
+                output->append(from+i, 1);
+            ++i;
+        }
+        else
+        {
+            char utf8[3];
+            output->append(utf8, encode_utf8(code, utf8));
+        }
     }
 
+    output->finish();
+}
+
+void CCharsetUtils::convert(const std::string& from_charset, const std::string& to_charset,
+                            const std::string& from, std::string* to,
+                            bool ignore_error, bool skip_error)
+{
+    std::string result; // 用来保存处理后的内容
+    const IconvEntry* entry = get_iconv(from_charset, to_charset);
+    COutput output(&result, from.size() + from.size()/2 + MAX_CHAR_BYTES); // gbk转utf-8时最多增长一半
+
+    do_convert(entry, from.data(), from.size(), &output, ignore_error, skip_error);
     // 不能直接使用to，因为to可能就是from
-    *to = result;
+    to->swap(result);
+}
+
+void CCharsetUtils::convert(const std::string& from_charset, const std::string& to_charset,
+                            const char* from, size_t from_size, char* to, size_t* to_size,
+                            bool ignore_error, bool skip_error)
+{
+    const IconvEntry* entry = get_iconv(from_charset, to_charset);
+    COutput output(to, *to_size);
+
+    do_convert(entry, from, from_size, &output, ignore_error, skip_error);
+    *to_size = output.size();
 }
 
 void CCharsetUtils::gbk_to_utf8(const std::string& from, std::string* to, bool ignore_error, bool skip_error)
 {
-    convert("gbk", "utf-8", from, to, ignore_error, skip_error);
+    const uint16_t* gbk_table = get_gbk_table();
+    if (NULL == gbk_table)
+    {
+        convert("gbk", "utf-8", from, to, ignore_error, skip_error);
+    }
+    else
+    {
+        std::string result;
+        COutput output(&result, from.size() + from.size()/2 + MAX_CHAR_BYTES);
+        fast_gbk_to_utf8(gbk_table, from.data(), from.size(), &output, ignore_error, skip_error);
+        to->swap(result);
+    }
 }
 
 void CCharsetUtils::utf8_to_gbk(const std::string& from, std::string* to, bool ignore_error, bool skip_error)
@@ -139,6 +484,26 @@ void CCharsetUtils::utf8_to_gbk(const std::string& from, std::string* to, bool i
     convert("utf-8", "gbk", from, to, ignore_error, skip_error);
 }
 
+void CCharsetUtils::gbk_to_utf8(const char* from, size_t from_size, char* to, size_t* to_size, bool ignore_error, bool skip_error)
+{
+    const uint16_t* gbk_table = get_gbk_table();
+    if (NULL == gbk_table)
+    {
+        convert("gbk", "utf-8", from, from_size, to, to_size, ignore_error, skip_error);
+    }
+    else
+    {
+        COutput output(to, *to_size);
+        fast_gbk_to_utf8(gbk_table, from, from_size, &output, ignore_error, skip_error);
+        *to_size = output.size();
+    }
+}
+
+void CCharsetUtils::utf8_to_gbk(const char* from, size_t from_size, char* to, size_t* to_size, bool ignore_error, bool skip_error)
+{
+    convert("utf-8", "gbk", from, from_size, to, to_size, ignore_error, skip_error);
+}
+
 void CCharsetUtils::gb2312_to_utf8(const std::string& from, std::string* to, bool ignore_error, bool skip_error)
 {
     convert("gb2312", "utf-8", from, to, ignore_error, skip_error);
@@ -149,4 +514,136 @@ void CCharsetUtils::utf8_to_gb2312(const std::string& from, std::string* to, boo
     convert("utf-8", "gb2312", from, to, ignore_error, skip_error);
 }
 
+bool CCharsetUtils::is_utf8(const char* str, size_t size, size_t* error_offset)
+{
+    const size_t offset = CStringSimd::find_invalid_utf8(str, size);
+    if (error_offset != NULL)
+        *error_offset = offset;
+    return offset == size;
+}
+
+bool CCharsetUtils::is_utf8(const std::string& str, size_t* error_offset)
+{
+    return is_utf8(str.data(), str.size(), error_offset);
+}
+
+size_t CCharsetUtils::utf8_to_utf16(const char* from, size_t from_size, char16_t* to)
+{
+    // 先整体校验，之后的解码不再检查
+    size_t error_offset;
+    if (!is_utf8(from, from_size, &error_offset))
+        THROW_EXCEPTION(CStringUtils::format_string("invalid utf-8 at offset %zu", error_offset), EILSEQ);
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(from);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < from_size)
+    {
+        const uint32_t c = bytes[i];
+        if (c < 0x80)
+        {
+#if MOOON_CHARSET_SSE2 == 1
+            // 连续16个ASCII时一次扩展成16个UTF-16单元
+            if (i+16 <= from_size)
+            {
+                const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from+i));
+                if (0 == _mm_movemask_epi8(x))
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(to+j), _mm_unpacklo_epi8(x, _mm_setzero_si128()));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(to+j+8), _mm_unpackhi_epi8(x, _mm_setzero_si128()));
+                    i += 16;
+                    j += 16;
+                    continue;
+                }
+            }
+#endif // MOOON_CHARSET_SSE2
+            to[j++] = static_cast<char16_t>(c);
+            i += 1;
+        }
+        else if (c < 0xE0)
+        {
+            to[j++] = static_cast<char16_t>(((c & 0x1F) << 6) | (bytes[i+1] & 0x3F));
+            i += 2;
+        }
+        else if (c < 0xF0)
+        {
+            to[j++] = static_cast<char16_t>(((c & 0x0F) << 12) | ((bytes[i+1] & 0x3F) << 6) | (bytes[i+2] & 0x3F));
+            i += 3;
+        }
+        else
+        {
+            const uint32_t code = (((c & 0x07) << 18) | ((bytes[i+1] & 0x3F) << 12) | ((bytes[i+2] & 0x3F) << 6) | (bytes[i+3] & 0x3F)) - 0x10000;
+            to[j++] = static_cast<char16_t>(0xD800 + (code >> 10));
+            to[j++] = static_cast<char16_t>(0xDC00 + (code & 0x3FF));
+            i += 4;
+        }
+    }
+
+    return j;
+}
+
+void CCharsetUtils::utf8_to_utf16(const std::string& from, std::u16string* to)
+{
+    std::u16string result(from.size(), 0);
+    result.resize(utf8_to_utf16(from.data(), from.size(), &result[0]));
+    to->swap(result);
+}
+
+size_t CCharsetUtils::utf16_to_utf8(const char16_t* from, size_t from_size, char* to)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while (i < from_size)
+    {
+        const uint32_t c = from[i];
+        if (c < 0x80)
+        {
+#if MOOON_CHARSET_SSE2 == 1
+            // 连续8个ASCII时一次压缩成8个字节
+            if (i+8 <= from_size)
+            {
+                const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from+i));
+                const __m128i non_ascii = _mm_and_si128(x, _mm_set1_epi16(static_cast<short>(0xFF80)));
+                if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi16(non_ascii, _mm_setzero_si128())))
+                {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(to+j), _mm_packus_epi16(x, x));
+                    i += 8;
+                    j += 8;
+                    continue;
+                }
+            }
+#endif // MOOON_CHARSET_SSE2
+            to[j++] = static_cast<char>(c);
+            i += 1;
+        }
+        else if ((c < 0xD800) || (c > 0xDFFF))
+        {
+            j += encode_utf8(c, to+j);
+            i += 1;
+        }
+        else if ((c < 0xDC00) && (i+1 < from_size) && (from[i+1] >= 0xDC00) && (from[i+1] <= 0xDFFF))
+        {
+            const uint32_t code = 0x10000 + ((c - 0xD800) << 10) + (from[i+1] - 0xDC00);
+            to[j++] = static_cast<char>(0xF0 | (code >> 18));
+            to[j++] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            to[j++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            to[j++] = static_cast<char>(0x80 | (code & 0x3F));
+            i += 2;
+        }
+        else
+        {
+            THROW_EXCEPTION(CStringUtils::format_string("unpaired surrogate at offset %zu", i), EILSEQ);
+        }
+    }
+
+    return j;
+}
+
+void CCharsetUtils::utf16_to_utf8(const std::u16string& from, std::string* to)
+{
+    std::string result(from.size()*3, '\0');
+    result.resize(utf16_to_utf8(from.data(), from.size(), &result[0]));
+    to->swap(result);
+}
+
 UTILS_NAMESPACE_END
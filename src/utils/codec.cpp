@@ -0,0 +1,577 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/codec.h"
+#include "utils/string_simd.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MOOON_CODEC_SIMD 1
+#endif
+UTILS_NAMESPACE_BEGIN
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// base64字符对应的6位值，非base64字符为0xFF
+static const unsigned char base64_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// 十六进制字符对应的值，非十六进制字符为0xFF
+static const unsigned char hex_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// URL编码时字符的类别：0为未保留字符，1为空格，2需要编码成%XX
+static const unsigned char url_classes[256] = {
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2,
+    2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 0,
+    2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 0, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+static inline bool is_base64_space(unsigned char c)
+{
+    return (' ' == c) || ('\n' == c) || ('\r' == c) || ('\t' == c);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 编码3字节的整数倍
+static void scalar_encode_triples(const unsigned char* src, size_t size, char* dest)
+{
+    for (size_t i=0; i<size; i+=3, dest+=4)
+    {
+        const uint32_t value = (static_cast<uint32_t>(src[i]) << 16) | (static_cast<uint32_t>(src[i+1]) << 8) | src[i+2];
+        dest[0] = base64_chars[(value >> 18) & 0x3F];
+        dest[1] = base64_chars[(value >> 12) & 0x3F];
+        dest[2] = base64_chars[(value >> 6) & 0x3F];
+        dest[3] = base64_chars[value & 0x3F];
+    }
+}
+
+// 编码不足3字节的尾部，带=填充
+static size_t encode_tail(const unsigned char* src, size_t size, char* dest)
+{
+    if (0 == size)
+        return 0;
+
+    const uint32_t value = (static_cast<uint32_t>(src[0]) << 16) | ((size > 1)? (static_cast<uint32_t>(src[1]) << 8): 0);
+    dest[0] = base64_chars[(value >> 18) & 0x3F];
+    dest[1] = base64_chars[(value >> 12) & 0x3F];
+    dest[2] = (size > 1)? base64_chars[(value >> 6) & 0x3F]: '=';
+    dest[3] = '=';
+    return 4;
+}
+
+// 解码尽可能多的完整4字符组，遇到非base64字符（包括=和空白）所在的组时停止
+// consumed返回已解码的字符数，为4的倍数
+static size_t scalar_decode_quartets(const unsigned char* src, size_t size, unsigned char* dest, size_t* consumed)
+{
+    size_t i = 0;
+    size_t j = 0;
+
+    for (; i+4<=size; i+=4, j+=3)
+    {
+        const uint32_t a = base64_values[src[i]];
+        const uint32_t b = base64_values[src[i+1]];
+        const uint32_t c = base64_values[src[i+2]];
+        const uint32_t d = base64_values[src[i+3]];
+        if ((a | b | c | d) & 0x80)
+            break;
+
+        const uint32_t value = (a << 18) | (b << 12) | (c << 6) | d;
+        dest[j] = static_cast<unsigned char>(value >> 16);
+        dest[j+1] = static_cast<unsigned char>(value >> 8);
+        dest[j+2] = static_cast<unsigned char>(value);
+    }
+
+    *consumed = i;
+    return j;
+}
+
+// 解码最后一组，size为1到4，可带=填充，也可不带
+static ssize_t decode_tail(const unsigned char* src, size_t size, unsigned char* dest)
+{
+    for (int padding=0; (size > 0) && ('=' == src[size-1]) && (padding < 2); ++padding)
+        --size;
+    if (size < 2)
+        return -1;
+
+    uint32_t value = 0;
+    for (size_t i=0; i<size; ++i)
+    {
+        const uint32_t c = base64_values[src[i]];
+        if (c & 0x80)
+            return -1;
+        value |= c << (18 - 6*i);
+    }
+
+    dest[0] = static_cast<unsigned char>(value >> 16);
+    if (size > 2)
+        dest[1] = static_cast<unsigned char>(value >> 8);
+    if (size > 3)
+        dest[2] = static_cast<unsigned char>(value);
+    return static_cast<ssize_t>(size - 1);
+}
+
+static ssize_t scalar_hex_decode(const unsigned char* src, size_t size, unsigned char* dest)
+{
+    for (size_t i=0; i<size; i+=2)
+    {
+        const unsigned char high = hex_values[src[i]];
+        const unsigned char low = hex_values[src[i+1]];
+        if ((high | low) & 0x80)
+            return -1;
+        dest[i/2] = static_cast<unsigned char>((high << 4) | low);
+    }
+
+    return static_cast<ssize_t>(size / 2);
+}
+
+#if MOOON_CODEC_SIMD == 1
+// 每次将24字节编码成32个字符，两个128位通道各处理12字节，
+// 先用pshufb把每3字节分到一个32位中，再用乘法把4个6位值移到各自的字节，最后查表转成字符
+// 参考：Wojciech Muła, Daniel Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions"
+__attribute__((target("avx2")))
+static size_t avx2_encode_triples(const unsigned char* src, size_t size, char* dest)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0,
+        'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0);
+    size_t i = 0;
+
+    // 第二个通道从src+12读16字节，需要至少28字节可读
+    for (; i+28<=size; i+=24, dest+=32)
+    {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, result), indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), result);
+    }
+
+    return i;
+}
+
+// 每次将32个字符解码成24字节，用高低半字节两次查表判断是否都是base64字符
+__attribute__((target("avx2")))
+static size_t avx2_decode_quartets(const unsigned char* src, size_t size, unsigned char* dest, size_t* consumed)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    size_t j = 0;
+
+    // 每次写入32字节，其中24字节有效，保留足够的余量以免写出dest
+    for (; i+44<=size; i+=32, j+=24)
+    {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+
+        const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+        const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        const __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        out = _mm256_shuffle_epi8(out, pack);
+        out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + j), out);
+    }
+
+    size_t tail_consumed = 0;
+    j += scalar_decode_quartets(src+i, size-i, dest+j, &tail_consumed);
+    *consumed = i + tail_consumed;
+    return j;
+}
+
+// 每次将32个十六进制字符转成16字节
+__attribute__((target("avx2")))
+static ssize_t avx2_hex_decode(const unsigned char* src, size_t size, unsigned char* dest)
+{
+    size_t i = 0;
+    for (; i+32<=size; i+=32)
+    {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i lower = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+        const __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1), in));
+        const __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('f'+1), lower));
+        if (_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha)) != -1)
+            return -1;
+
+        const __m256i values = _mm256_blendv_epi8(_mm256_sub_epi8(lower, _mm256_set1_epi8('a'-10)), _mm256_sub_epi8(in, _mm256_set1_epi8('0')), is_digit);
+        // 每两个值合成一个字节：高位乘16加低位
+        const __m256i words = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0110));
+        const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i/2), _mm256_castsi256_si128(bytes));
+    }
+
+    const ssize_t tail = scalar_hex_decode(src+i, size-i, dest+i/2);
+    return (tail < 0)? -1: static_cast<ssize_t>(size / 2);
+}
+#endif // MOOON_CODEC_SIMD
+
+static bool detect_avx2()
+{
+#if MOOON_CODEC_SIMD == 1
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif // MOOON_CODEC_SIMD
+}
+
+static bool& use_avx2()
+{
+    static bool avx2 = detect_avx2();
+    return avx2;
+}
+
+static size_t encode_triples(const unsigned char* src, size_t size, char* dest)
+{
+    size_t i = 0;
+#if MOOON_CODEC_SIMD == 1
+    if (use_avx2())
+        i = avx2_encode_triples(src, size, dest);
+#endif // MOOON_CODEC_SIMD
+
+    scalar_encode_triples(src+i, size-i, dest+i/3*4);
+    return size / 3 * 4;
+}
+
+static size_t decode_quartets(const unsigned char* src, size_t size, unsigned char* dest, size_t* consumed)
+{
+#if MOOON_CODEC_SIMD == 1
+    if (use_avx2())
+        return avx2_decode_quartets(src, size, dest, consumed);
+#endif // MOOON_CODEC_SIMD
+    return scalar_decode_quartets(src, size, dest, consumed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t CCodec::base64_encode(const void* src, size_t size, char* dest)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(src);
+    const size_t tail_size = size % 3;
+    const size_t n = encode_triples(bytes, size-tail_size, dest);
+    return n + encode_tail(bytes+size-tail_size, tail_size, dest+n);
+}
+
+ssize_t CCodec::base64_decode(const char* src, size_t size, void* dest)
+{
+    const unsigned char* chars = reinterpret_cast<const unsigned char*>(src);
+    unsigned char* bytes = static_cast<unsigned char*>(dest);
+    size_t consumed = 0;
+    const size_t n = decode_quartets(chars, size, bytes, &consumed);
+
+    // 剩余的只能是最后一组
+    const size_t rest = size - consumed;
+    if (0 == rest)
+        return static_cast<ssize_t>(n);
+    if (rest > 4)
+        return -1;
+
+    const ssize_t tail = decode_tail(chars+consumed, rest, bytes+n);
+    return (tail < 0)? -1: static_cast<ssize_t>(n) + tail;
+}
+
+std::string CCodec::base64_encode(const std::string& src)
+{
+    std::string dest(base64_encoded_size(src.size()), '\0');
+    if (!src.empty())
+        base64_encode(src.data(), src.size(), &dest[0]);
+    return dest;
+}
+
+bool CCodec::base64_decode(const std::string& src, std::string* dest)
+{
+    dest->resize(base64_decoded_size_max(src.size()));
+    const ssize_t n = base64_decode(src.data(), src.size(), &(*dest)[0]);
+    dest->resize((n > 0)? static_cast<size_t>(n): 0);
+    return n >= 0;
+}
+
+void CCodec::hex_encode(const void* src, size_t size, char* dest, bool lowercase)
+{
+    CStringSimd::to_hex(static_cast<const unsigned char*>(src), size, dest, lowercase);
+}
+
+ssize_t CCodec::hex_decode(const char* src, size_t size, void* dest)
+{
+    if (size % 2 != 0)
+        return -1;
+
+#if MOOON_CODEC_SIMD == 1
+    if (use_avx2())
+        return avx2_hex_decode(reinterpret_cast<const unsigned char*>(src), size, static_cast<unsigned char*>(dest));
+#endif // MOOON_CODEC_SIMD
+    return scalar_hex_decode(reinterpret_cast<const unsigned char*>(src), size, static_cast<unsigned char*>(dest));
+}
+
+size_t CCodec::url_encode(const char* src, size_t size, char* dest, bool space2plus)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const unsigned char* chars = reinterpret_cast<const unsigned char*>(src);
+    size_t j = 0;
+
+    for (size_t i=0; i<size; )
+    {
+        // 连续的未保留字符整段复制
+        size_t k = i;
+        while ((k < size) && (0 == url_classes[chars[k]]))
+            ++k;
+        memcpy(dest+j, src+i, k-i);
+        j += k - i;
+        if (k == size)
+            break;
+
+        const unsigned char c = chars[k];
+        if ((1 == url_classes[c]) && space2plus)
+        {
+            dest[j++] = '+';
+        }
+        else
+        {
+            dest[j] = '%';
+            dest[j+1] = hex[c >> 4];
+            dest[j+2] = hex[c & 0x0F];
+            j += 3;
+        }
+        i = k + 1;
+    }
+
+    return j;
+}
+
+size_t CCodec::url_decode(const char* src, size_t size, char* dest)
+{
+    const unsigned char* chars = reinterpret_cast<const unsigned char*>(src);
+    size_t j = 0;
+
+    for (size_t i=0; i<size; )
+    {
+        const char c = src[i];
+        if ('+' == c)
+        {
+            dest[j++] = ' ';
+            ++i;
+        }
+        else if (('%' == c) && (i+2 < size) && !((hex_values[chars[i+1]] | hex_values[chars[i+2]]) & 0x80))
+        {
+            dest[j++] = static_cast<char>((hex_values[chars[i+1]] << 4) | hex_values[chars[i+2]]);
+            i += 3;
+        }
+        else
+        {
+            dest[j++] = c;
+            ++i;
+        }
+    }
+
+    return j;
+}
+
+bool CCodec::is_accelerated()
+{
+    return use_avx2();
+}
+
+void CCodec::set_software_only(bool software_only)
+{
+    use_avx2() = software_only? false: detect_avx2();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CBase64Encoder::CBase64Encoder()
+    : _carry_size(0)
+{
+}
+
+size_t CBase64Encoder::update(const void* data, size_t size, char* dest)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t n = 0;
+
+    // 先补齐上次剩下的尾部
+    if (_carry_size > 0)
+    {
+        while ((_carry_size < 3) && (size > 0))
+        {
+            _carry[_carry_size++] = *bytes++;
+            --size;
+        }
+        if (_carry_size < 3)
+            return 0;
+
+        n = encode_triples(_carry, 3, dest);
+        _carry_size = 0;
+    }
+
+    const size_t tail_size = size % 3;
+    n += encode_triples(bytes, size-tail_size, dest+n);
+    memcpy(_carry, bytes+size-tail_size, tail_size);
+    _carry_size = tail_size;
+    return n;
+}
+
+size_t CBase64Encoder::finish(char* dest)
+{
+    const size_t n = encode_tail(_carry, _carry_size, dest);
+    _carry_size = 0;
+    return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CBase64Decoder::CBase64Decoder()
+{
+    reset();
+}
+
+void CBase64Decoder::reset()
+{
+    _carry_size = 0;
+    _finished = false;
+    _failed = false;
+}
+
+ssize_t CBase64Decoder::update(const char* data, size_t size, void* dest)
+{
+    const unsigned char* chars = reinterpret_cast<const unsigned char*>(data);
+    unsigned char* bytes = static_cast<unsigned char*>(dest);
+    size_t n = 0;
+
+    if (_failed)
+        return -1;
+    for (size_t i=0; i<size; )
+    {
+        // 没有跨段的组时，整段快速解码，直到遇到空白或填充所在的组
+        if ((0 == _carry_size) && !_finished)
+        {
+            size_t consumed = 0;
+            n += decode_quartets(chars+i, size-i, bytes+n, &consumed);
+            i += consumed;
+            if (i == size)
+                break;
+        }
+
+        // 逐个字符处理
+        const unsigned char c = chars[i++];
+        if (is_base64_space(c))
+            continue;
+        if (_finished || (('=' != c) && (base64_values[c] & 0x80)))
+        {
+            _failed = true;
+            return -1;
+        }
+
+        _carry[_carry_size++] = c;
+        if (4 == _carry_size)
+        {
+            const ssize_t tail = decode_tail(_carry, 4, bytes+n);
+            if (tail < 0)
+            {
+                _failed = true;
+                return -1;
+            }
+
+            n += tail;
+            _finished = (tail < 3);
+            _carry_size = 0;
+        }
+    }
+
+    return static_cast<ssize_t>(n);
+}
+
+ssize_t CBase64Decoder::finish(void* dest)
+{
+    if (_failed)
+        return -1;
+    if (0 == _carry_size)
+        return 0;
+
+    const ssize_t tail = decode_tail(_carry, _carry_size, static_cast<unsigned char*>(dest));
+    _carry_size = 0;
+    _finished = true;
+    return tail;
+}
+
+UTILS_NAMESPACE_END
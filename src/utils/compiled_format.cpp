@@ -0,0 +1,355 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/compiled_format.h"
+#include "utils/string_utils.h"
+#include <ctype.h>
+UTILS_NAMESPACE_BEGIN
+
+CFormatBuffer::CFormatBuffer()
+    : _data(_inline_buffer), _size(0), _capacity(sizeof(_inline_buffer))
+{
+}
+
+CFormatBuffer::~CFormatBuffer()
+{
+    if (_data != _inline_buffer)
+        delete []_data;
+}
+
+void CFormatBuffer::append(const char* str, size_t size)
+{
+    memcpy(prepare(size), str, size);
+    _size += size;
+}
+
+void CFormatBuffer::append(char c)
+{
+    *prepare(1) = c;
+    ++_size;
+}
+
+char* CFormatBuffer::prepare(size_t size)
+{
+    if (_size + size > _capacity)
+    {
+        size_t capacity = _capacity * 2;
+        while (capacity < _size + size)
+            capacity *= 2;
+
+        char* data = new char[capacity];
+        memcpy(data, _data, _size);
+        if (_data != _inline_buffer)
+            delete []_data;
+        _data = data;
+        _capacity = capacity;
+    }
+
+    return _data + _size;
+}
+
+const char* CFormatBuffer::c_str()
+{
+    // 结尾符不计入大小
+    *prepare(1) = '\0';
+    return _data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CCompiledFormat::CCompiledFormat(const char* format)
+    : _format(format), _conversion_number(0)
+{
+    parse();
+}
+
+CCompiledFormat::CCompiledFormat(const std::string& format)
+    : _format(format), _conversion_number(0)
+{
+    parse();
+}
+
+void CCompiledFormat::parse()
+{
+    const char* format = _format.c_str();
+    const uint32_t size = static_cast<uint32_t>(_format.size());
+    uint32_t i = 0;
+
+    while (i < size)
+    {
+        Segment segment;
+        memset(&segment, 0, sizeof(segment));
+        segment.offset = i;
+
+        if ((format[i] != '%') || ((i+1 < size) && ('%' == format[i+1])))
+        {
+            // 普通字符，%%当作一个%
+            segment.literal = true;
+            if ('%' == format[i])
+            {
+                segment.offset = ++i;
+                ++i;
+            }
+            while ((i < size) && (format[i] != '%'))
+                ++i;
+            segment.size = i - segment.offset;
+            if (!_segments.empty() && _segments.back().literal && (_segments.back().offset+_segments.back().size == segment.offset))
+                _segments.back().size += segment.size;
+            else
+                _segments.push_back(segment);
+            continue;
+        }
+
+        // 转换：%[flags][width][.precision][length]conversion
+        uint32_t j = i + 1;
+        int num_flags = 0;
+        while ((j < size) && (strchr("-+ #0", format[j]) != NULL) && (format[j] != '\0'))
+        {
+            if (num_flags < static_cast<int>(sizeof(segment.flags))-1)
+                segment.flags[num_flags++] = format[j];
+            ++j;
+        }
+
+        segment.width = -1;
+        if ((j < size) && ('*' == format[j]))
+        {
+            segment.star_width = true;
+            ++j;
+        }
+        else if ((j < size) && isdigit(static_cast<unsigned char>(format[j])))
+        {
+            segment.width = 0;
+            while ((j < size) && isdigit(static_cast<unsigned char>(format[j])))
+                segment.width = segment.width * 10 + (format[j++] - '0');
+        }
+
+        segment.precision = -1;
+        if ((j < size) && ('.' == format[j]))
+        {
+            ++j;
+            if ((j < size) && ('*' == format[j]))
+            {
+                segment.star_precision = true;
+                ++j;
+            }
+            else
+            {
+                segment.precision = 0;
+                while ((j < size) && isdigit(static_cast<unsigned char>(format[j])))
+                    segment.precision = segment.precision * 10 + (format[j++] - '0');
+            }
+        }
+
+        while ((j < size) && (strchr("hlLqjzt", format[j]) != NULL))
+            ++j;
+
+        if ((j < size) && (strchr("diouxXeEfFgGaAcsp", format[j]) != NULL))
+        {
+            segment.conversion = format[j];
+            segment.simple = (0 == num_flags) && (-1 == segment.width) && (-1 == segment.precision) && !segment.star_width && !segment.star_precision;
+            segment.size = j + 1 - i;
+            _segments.push_back(segment);
+            ++_conversion_number;
+            i = j + 1;
+        }
+        else
+        {
+            // 不认识的转换原样输出
+            segment.literal = true;
+            segment.size = ((j < size)? j + 1: j) - i;
+            _segments.push_back(segment);
+            i += segment.size;
+        }
+    }
+}
+
+void CCompiledFormat::format_to(CFormatBuffer* buffer, const CFormatArg* args, int num_args) const
+{
+    const char* format = _format.data();
+    int arg_index = 0;
+
+    for (std::vector<Segment>::size_type i=0; i<_segments.size(); ++i)
+    {
+        const Segment& segment = _segments[i];
+        if (segment.literal)
+        {
+            buffer->append(format+segment.offset, segment.size);
+            continue;
+        }
+
+        int width = segment.width;
+        int precision = segment.precision;
+        if (segment.star_width)
+        {
+            width = (arg_index < num_args)? static_cast<int>(args[arg_index].int_value()): -1;
+            ++arg_index;
+        }
+        if (segment.star_precision)
+        {
+            precision = (arg_index < num_args)? static_cast<int>(args[arg_index].int_value()): -1;
+            ++arg_index;
+        }
+        if (arg_index >= num_args)
+            break;
+
+        format_conversion(buffer, segment, args[arg_index++], width, precision);
+    }
+}
+
+void CCompiledFormat::format_conversion(CFormatBuffer* buffer, const Segment& segment, const CFormatArg& arg, int width, int precision) const
+{
+    const char conversion = segment.conversion;
+    const bool integer_conversion = (strchr("diu", conversion) != NULL);
+
+    // 快速路径：不经过snprintf
+    if (segment.simple)
+    {
+        switch (arg.type())
+        {
+        case CFormatArg::arg_int:
+            if (integer_conversion || ('s' == conversion))
+            {
+                buffer->commit(CStringUtils::int64_toa(arg.int_value(), buffer->prepare(20)));
+                return;
+            }
+            break;
+        case CFormatArg::arg_uint:
+            if (integer_conversion || ('s' == conversion))
+            {
+                buffer->commit(CStringUtils::uint64_toa(arg.uint_value(), buffer->prepare(20)));
+                return;
+            }
+            break;
+        case CFormatArg::arg_char:
+            if (('c' == conversion) || ('s' == conversion))
+            {
+                buffer->append(static_cast<char>(arg.int_value()));
+                return;
+            }
+            break;
+        case CFormatArg::arg_string:
+            buffer->append(arg.string_value(), (arg.string_size() < 0)? strlen(arg.string_value()): static_cast<size_t>(arg.string_size()));
+            return;
+        case CFormatArg::arg_double:
+            if ('s' == conversion)
+            {
+                buffer->commit(CStringUtils::double_toa(arg.double_value(), buffer->prepare(CStringUtils::DOUBLE_TOA_BUFFER_SIZE)));
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 按参数的实际类型重新组织单个转换的格式，再由snprintf完成
+    char spec[32];
+    int n = 0;
+    spec[n++] = '%';
+    for (const char* flag=segment.flags; *flag!='\0'; ++flag)
+        spec[n++] = *flag;
+    if (width >= 0)
+        n += snprintf(spec+n, sizeof(spec)-n, "%d", width);
+    if (precision >= 0)
+        n += snprintf(spec+n, sizeof(spec)-n, ".%d", precision);
+
+    const bool float_conversion = (strchr("eEfFgGaA", conversion) != NULL);
+    char number[CStringUtils::DOUBLE_TOA_BUFFER_SIZE];
+    CFormatArg value = arg;
+    switch (arg.type())
+    {
+    case CFormatArg::arg_int:
+    case CFormatArg::arg_uint:
+        if (float_conversion)
+        {
+            value = CFormatArg((CFormatArg::arg_int == arg.type())? static_cast<double>(arg.int_value()): static_cast<double>(arg.uint_value()));
+            spec[n++] = conversion;
+        }
+        else if ('c' == conversion)
+        {
+            spec[n++] = 'c';
+        }
+        else
+        {
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = (strchr("ouxX", conversion) != NULL)? conversion: ((CFormatArg::arg_int == arg.type())? 'd': 'u');
+        }
+        break;
+    case CFormatArg::arg_char:
+        spec[n++] = integer_conversion? 'd': 'c';
+        break;
+    case CFormatArg::arg_double:
+        if (float_conversion)
+        {
+            spec[n++] = conversion;
+        }
+        else
+        {
+            // 按最短表示转成字符串后再应用宽度
+            number[CStringUtils::double_toa(arg.double_value(), number)] = '\0';
+            value = CFormatArg(static_cast<const char*>(number));
+            spec[n++] = 's';
+        }
+        break;
+    case CFormatArg::arg_pointer:
+        spec[n++] = 'p';
+        break;
+    default:
+        spec[n++] = 's';
+        break;
+    }
+    spec[n] = '\0';
+
+    for (size_t space=64; ; )
+    {
+        char* tail = buffer->prepare(space);
+        int bytes;
+        switch (value.type())
+        {
+        case CFormatArg::arg_int:
+            bytes = ('c' == spec[n-1])? snprintf(tail, space, spec, static_cast<int>(value.int_value())): snprintf(tail, space, spec, static_cast<long long>(value.int_value()));
+            break;
+        case CFormatArg::arg_uint:
+            bytes = ('c' == spec[n-1])? snprintf(tail, space, spec, static_cast<int>(value.uint_value())): snprintf(tail, space, spec, static_cast<unsigned long long>(value.uint_value()));
+            break;
+        case CFormatArg::arg_char:
+            bytes = snprintf(tail, space, spec, static_cast<int>(value.int_value()));
+            break;
+        case CFormatArg::arg_double:
+            bytes = snprintf(tail, space, spec, value.double_value());
+            break;
+        case CFormatArg::arg_pointer:
+            bytes = snprintf(tail, space, spec, value.pointer_value());
+            break;
+        default:
+            bytes = snprintf(tail, space, spec, value.string_value());
+            break;
+        }
+
+        if (bytes < 0)
+            return;
+        if (static_cast<size_t>(bytes) < space)
+        {
+            buffer->commit(bytes);
+            return;
+        }
+        space = static_cast<size_t>(bytes) + 1;
+    }
+}
+
+UTILS_NAMESPACE_END
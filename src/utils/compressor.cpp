@@ -0,0 +1,798 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/compressor.h"
+#include "utils/exception.h"
+#include "utils/string_utils.h"
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <zlib.h>
+#if MOOON_HAVE_ZSTD == 1
+#include <zstd.h>
+#endif // MOOON_HAVE_ZSTD
+#if MOOON_HAVE_LZ4 == 1
+#include <lz4frame.h>
+#endif // MOOON_HAVE_LZ4
+UTILS_NAMESPACE_BEGIN
+
+// 每次至少为输出扩大的字节数
+#define COMPRESSOR_CHUNK_SIZE 16384
+// zlib的avail_in为uInt，超过的分段输入
+#define COMPRESSOR_MAX_ZLIB_INPUT (1U << 30)
+
+enum
+{
+    MODE_CONTINUE = 0,
+    MODE_FLUSH    = 1,
+    MODE_FINISH   = 2
+};
+
+// 为输出扩大至少chunk_size字节，返回新增空间的起始位置
+static char* grow_output(std::string* out, size_t chunk_size, size_t* old_size)
+{
+    *old_size = out->size();
+    out->resize(*old_size + chunk_size);
+    return &(*out)[*old_size];
+}
+
+// 输入越大一次扩大的越多，减少resize的次数
+static size_t get_chunk_size(size_t input_size)
+{
+    const size_t chunk_size = input_size / 2;
+    if (chunk_size < COMPRESSOR_CHUNK_SIZE)
+        return COMPRESSOR_CHUNK_SIZE;
+    return (chunk_size > COMPRESSOR_MAX_ZLIB_INPUT)? COMPRESSOR_MAX_ZLIB_INPUT: chunk_size;
+}
+
+bool is_compression_supported(compression_t compression)
+{
+    switch (compression)
+    {
+    case compression_none:
+    case compression_gzip:
+    case compression_zlib:
+        return true;
+    case compression_zstd:
+#if MOOON_HAVE_ZSTD == 1
+        return true;
+#else
+        return false;
+#endif // MOOON_HAVE_ZSTD
+    case compression_lz4:
+#if MOOON_HAVE_LZ4 == 1
+        return true;
+#else
+        return false;
+#endif // MOOON_HAVE_LZ4
+    default:
+        return false;
+    }
+}
+
+const char* get_compression_name(compression_t compression)
+{
+    static const char* names[compression_max] = { "none", "gzip", "zlib", "zstd", "lz4" };
+    return ((compression >= compression_none) && (compression < compression_max))? names[compression]: "unknown";
+}
+
+compression_t get_compression_by_name(const std::string& name)
+{
+    for (int i=compression_none; i<compression_max; ++i)
+    {
+        if (name == get_compression_name(static_cast<compression_t>(i)))
+            return static_cast<compression_t>(i);
+    }
+    THROW_EXCEPTION(CStringUtils::format_string("unknown compression: %s", name.c_str()), EINVAL);
+}
+
+const char* get_compression_suffix(compression_t compression)
+{
+    static const char* suffixes[compression_max] = { "", ".gz", ".zz", ".zst", ".lz4" };
+    return ((compression >= compression_none) && (compression < compression_max))? suffixes[compression]: "";
+}
+
+compression_t detect_compression(const char* data, size_t size)
+{
+    const unsigned char* magic = reinterpret_cast<const unsigned char*>(data);
+    if ((size >= 2) && (0x1F == magic[0]) && (0x8B == magic[1]))
+        return compression_gzip;
+    if ((size >= 4) && (0x28 == magic[0]) && (0xB5 == magic[1]) && (0x2F == magic[2]) && (0xFD == magic[3]))
+        return compression_zstd;
+    if ((size >= 4) && (0x04 == magic[0]) && (0x22 == magic[1]) && (0x4D == magic[2]) && (0x18 == magic[3]))
+        return compression_lz4;
+    return compression_none;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct CCompressor::Backend
+{
+    virtual ~Backend() {}
+
+    // mode为MODE_CONTINUE、MODE_FLUSH或MODE_FINISH
+    virtual void compress(const char* data, size_t size, int mode, std::string* out) = 0;
+    virtual void reset() = 0;
+};
+
+struct CDecompressor::Backend
+{
+    virtual ~Backend() {}
+    virtual bool decompress(const char* data, size_t size, std::string* out) = 0;
+    virtual void reset() = 0;
+};
+
+class CNoneCompressor: public CCompressor::Backend
+{
+public:
+    virtual void compress(const char* data, size_t size, int, std::string* out)
+    {
+        out->append(data, size);
+    }
+
+    virtual void reset()
+    {
+    }
+};
+
+class CNoneDecompressor: public CDecompressor::Backend
+{
+public:
+    virtual bool decompress(const char* data, size_t size, std::string* out)
+    {
+        out->append(data, size);
+        return true;
+    }
+
+    virtual void reset()
+    {
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class CZlibCompressor: public CCompressor::Backend
+{
+public:
+    CZlibCompressor(bool gzip, int level, const std::string& dictionary)
+        : _dictionary(dictionary)
+    {
+        if (gzip && !dictionary.empty())
+            THROW_EXCEPTION("gzip does not support dictionary", EINVAL);
+
+        memset(&_stream, 0, sizeof(_stream));
+        // 15+16表示带gzip头和尾，可用gzip -dc解压
+        const int errcode = deflateInit2(&_stream, (-1 == level)? Z_DEFAULT_COMPRESSION: level, Z_DEFLATED, gzip? 15+16: 15, 8, Z_DEFAULT_STRATEGY);
+        if (errcode != Z_OK)
+            THROW_EXCEPTION(CStringUtils::format_string("deflateInit2 failed: %s", zError(errcode)), errcode);
+        set_dictionary();
+    }
+
+    virtual ~CZlibCompressor()
+    {
+        deflateEnd(&_stream);
+    }
+
+    virtual void compress(const char* data, size_t size, int mode, std::string* out)
+    {
+        const int flush = (MODE_FINISH == mode)? Z_FINISH: ((MODE_FLUSH == mode)? Z_SYNC_FLUSH: Z_NO_FLUSH);
+        size_t remaining = size;
+
+        _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _stream.avail_in = 0;
+        for (;;)
+        {
+            if ((0 == _stream.avail_in) && (remaining > 0))
+            {
+                _stream.avail_in = (remaining > COMPRESSOR_MAX_ZLIB_INPUT)? COMPRESSOR_MAX_ZLIB_INPUT: static_cast<uInt>(remaining);
+                remaining -= _stream.avail_in;
+            }
+
+            size_t old_size;
+            const size_t chunk_size = get_chunk_size(_stream.avail_in + remaining);
+            _stream.next_out = reinterpret_cast<Bytef*>(grow_output(out, chunk_size, &old_size));
+            _stream.avail_out = static_cast<uInt>(chunk_size);
+
+            // 有剩余未输入的数据时不能flush，否则会在中间产生多余的同步点
+            const int errcode = deflate(&_stream, (remaining > 0)? Z_NO_FLUSH: flush);
+            out->resize(old_size + chunk_size - _stream.avail_out);
+            if ((errcode != Z_OK) && (errcode != Z_STREAM_END) && (errcode != Z_BUF_ERROR))
+                THROW_EXCEPTION(CStringUtils::format_string("deflate failed: %s", zError(errcode)), errcode);
+
+            if ((remaining > 0) || (_stream.avail_in > 0) || (0 == _stream.avail_out))
+                continue;
+            if ((MODE_FINISH == mode) && (errcode != Z_STREAM_END))
+                continue;
+            break;
+        }
+    }
+
+    virtual void reset()
+    {
+        deflateReset(&_stream);
+        set_dictionary();
+    }
+
+private:
+    void set_dictionary()
+    {
+        if (!_dictionary.empty())
+        {
+            const int errcode = deflateSetDictionary(&_stream, reinterpret_cast<const Bytef*>(_dictionary.data()), static_cast<uInt>(_dictionary.size()));
+            if (errcode != Z_OK)
+                THROW_EXCEPTION(CStringUtils::format_string("deflateSetDictionary failed: %s", zError(errcode)), errcode);
+        }
+    }
+
+private:
+    z_stream _stream;
+    const std::string _dictionary;
+};
+
+// gzip和zlib格式都可解，流结束后还有输入时重置，以解拼接的多个流
+class CZlibDecompressor: public CDecompressor::Backend
+{
+public:
+    CZlibDecompressor(const std::string& dictionary)
+        : _dictionary(dictionary), _finished(false)
+    {
+        memset(&_stream, 0, sizeof(_stream));
+        // 15+32表示自动识别gzip和zlib头
+        const int errcode = inflateInit2(&_stream, 15+32);
+        if (errcode != Z_OK)
+            THROW_EXCEPTION(CStringUtils::format_string("inflateInit2 failed: %s", zError(errcode)), errcode);
+    }
+
+    virtual ~CZlibDecompressor()
+    {
+        inflateEnd(&_stream);
+    }
+
+    virtual bool decompress(const char* data, size_t size, std::string* out)
+    {
+        size_t remaining = size;
+
+        _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _stream.avail_in = 0;
+        for (;;)
+        {
+            if ((0 == _stream.avail_in) && (remaining > 0))
+            {
+                _stream.avail_in = (remaining > COMPRESSOR_MAX_ZLIB_INPUT)? COMPRESSOR_MAX_ZLIB_INPUT: static_cast<uInt>(remaining);
+                remaining -= _stream.avail_in;
+            }
+            if (_finished)
+            {
+                if (0 == _stream.avail_in)
+                    break;
+                inflateReset(&_stream);
+                _finished = false;
+            }
+
+            size_t old_size;
+            const size_t chunk_size = get_chunk_size((_stream.avail_in + remaining) * 2);
+            _stream.next_out = reinterpret_cast<Bytef*>(grow_output(out, chunk_size, &old_size));
+            _stream.avail_out = static_cast<uInt>(chunk_size);
+
+            int errcode = inflate(&_stream, Z_NO_FLUSH);
+            if (Z_NEED_DICT == errcode)
+            {
+                if (_dictionary.empty())
+                    THROW_EXCEPTION("zlib stream needs dictionary", errcode);
+                errcode = inflateSetDictionary(&_stream, reinterpret_cast<const Bytef*>(_dictionary.data()), static_cast<uInt>(_dictionary.size()));
+                if (Z_OK == errcode)
+                    errcode = inflate(&_stream, Z_NO_FLUSH);
+            }
+            out->resize(old_size + chunk_size - _stream.avail_out);
+
+            if (Z_STREAM_END == errcode)
+            {
+                _finished = true;
+            }
+            else if ((errcode != Z_OK) && (errcode != Z_BUF_ERROR))
+            {
+                THROW_EXCEPTION(CStringUtils::format_string("inflate failed: %s", (_stream.msg != NULL)? _stream.msg: zError(errcode)), errcode);
+            }
+            else if ((0 == _stream.avail_in) && (0 == remaining) && (_stream.avail_out > 0))
+            {
+                break;
+            }
+        }
+
+        return _finished;
+    }
+
+    virtual void reset()
+    {
+        inflateReset(&_stream);
+        _finished = false;
+    }
+
+private:
+    z_stream _stream;
+    const std::string _dictionary;
+    bool _finished;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+#if MOOON_HAVE_ZSTD == 1
+static void check_zstd_result(size_t result, const char* function)
+{
+    if (ZSTD_isError(result))
+        THROW_EXCEPTION(CStringUtils::format_string("%s failed: %s", function, ZSTD_getErrorName(result)), static_cast<int>(ZSTD_getErrorCode(result)));
+}
+
+class CZstdCompressor: public CCompressor::Backend
+{
+public:
+    CZstdCompressor(int level, const std::string& dictionary)
+    {
+        _context = ZSTD_createCCtx();
+        if (NULL == _context)
+            THROW_EXCEPTION("ZSTD_createCCtx failed", ENOMEM);
+
+        try
+        {
+            check_zstd_result(ZSTD_CCtx_setParameter(_context, ZSTD_c_compressionLevel, (-1 == level)? ZSTD_CLEVEL_DEFAULT: level), "ZSTD_CCtx_setParameter");
+            // 加载的字典在reset（只重置会话）后仍然有效
+            if (!dictionary.empty())
+                check_zstd_result(ZSTD_CCtx_loadDictionary(_context, dictionary.data(), dictionary.size()), "ZSTD_CCtx_loadDictionary");
+        }
+        catch (...)
+        {
+            ZSTD_freeCCtx(_context);
+            throw;
+        }
+    }
+
+    virtual ~CZstdCompressor()
+    {
+        ZSTD_freeCCtx(_context);
+    }
+
+    virtual void compress(const char* data, size_t size, int mode, std::string* out)
+    {
+        const ZSTD_EndDirective directive = (MODE_FINISH == mode)? ZSTD_e_end: ((MODE_FLUSH == mode)? ZSTD_e_flush: ZSTD_e_continue);
+        ZSTD_inBuffer input = { data, size, 0 };
+
+        for (;;)
+        {
+            size_t old_size;
+            const size_t chunk_size = ZSTD_CStreamOutSize();
+            ZSTD_outBuffer output = { grow_output(out, chunk_size, &old_size), chunk_size, 0 };
+            const size_t remaining = ZSTD_compressStream2(_context, &output, &input, directive);
+            out->resize(old_size + output.pos);
+            check_zstd_result(remaining, "ZSTD_compressStream2");
+
+            // flush和end时返回值为还未输出的字节数
+            if ((ZSTD_e_continue == directive)? (input.pos == input.size): (0 == remaining))
+                break;
+        }
+    }
+
+    virtual void reset()
+    {
+        ZSTD_CCtx_reset(_context, ZSTD_reset_session_only);
+    }
+
+private:
+    ZSTD_CCtx* _context;
+};
+
+class CZstdDecompressor: public CDecompressor::Backend
+{
+public:
+    CZstdDecompressor(const std::string& dictionary)
+        : _finished(false)
+    {
+        _context = ZSTD_createDCtx();
+        if (NULL == _context)
+            THROW_EXCEPTION("ZSTD_createDCtx failed", ENOMEM);
+
+        if (!dictionary.empty())
+        {
+            const size_t result = ZSTD_DCtx_loadDictionary(_context, dictionary.data(), dictionary.size());
+            if (ZSTD_isError(result))
+            {
+                ZSTD_freeDCtx(_context);
+                check_zstd_result(result, "ZSTD_DCtx_loadDictionary");
+            }
+        }
+    }
+
+    virtual ~CZstdDecompressor()
+    {
+        ZSTD_freeDCtx(_context);
+    }
+
+    // 一帧解完后，再有输入时自动开始下一帧
+    virtual bool decompress(const char* data, size_t size, std::string* out)
+    {
+        ZSTD_inBuffer input = { data, size, 0 };
+
+        while (input.pos < input.size)
+        {
+            size_t old_size;
+            const size_t chunk_size = ZSTD_DStreamOutSize();
+            ZSTD_outBuffer output = { grow_output(out, chunk_size, &old_size), chunk_size, 0 };
+            const size_t result = ZSTD_decompressStream(_context, &output, &input);
+            out->resize(old_size + output.pos);
+            check_zstd_result(result, "ZSTD_decompressStream");
+
+            _finished = (0 == result);
+            // 输出满了时可能还有缓存在上下文中的数据
+            while (!_finished && (output.pos == output.size) && (input.pos == input.size))
+            {
+                output.dst = grow_output(out, chunk_size, &old_size);
+                output.size = chunk_size;
+                output.pos = 0;
+                const size_t more = ZSTD_decompressStream(_context, &output, &input);
+                out->resize(old_size + output.pos);
+                check_zstd_result(more, "ZSTD_decompressStream");
+                _finished = (0 == more);
+            }
+        }
+
+        return _finished;
+    }
+
+    virtual void reset()
+    {
+        ZSTD_DCtx_reset(_context, ZSTD_reset_session_only);
+        _finished = false;
+    }
+
+private:
+    ZSTD_DCtx* _context;
+    bool _finished;
+};
+#endif // MOOON_HAVE_ZSTD
+
+////////////////////////////////////////////////////////////////////////////////
+#if MOOON_HAVE_LZ4 == 1
+static void check_lz4_result(size_t result, const char* function)
+{
+    if (LZ4F_isError(result))
+        THROW_EXCEPTION(CStringUtils::format_string("%s failed: %s", function, LZ4F_getErrorName(result)), EINVAL);
+}
+
+// 帧头在第一次输入时才写，reset后未输入就finish的也有完整的空帧
+class CLz4Compressor: public CCompressor::Backend
+{
+public:
+    CLz4Compressor(int level, const std::string& dictionary)
+        : _started(false)
+    {
+        if (!dictionary.empty())
+            THROW_EXCEPTION("lz4 does not support dictionary", EINVAL);
+        check_lz4_result(LZ4F_createCompressionContext(&_context, LZ4F_VERSION), "LZ4F_createCompressionContext");
+
+        memset(&_preferences, 0, sizeof(_preferences));
+        _preferences.compressionLevel = (-1 == level)? 0: level;
+        _preferences.frameInfo.blockMode = LZ4F_blockLinked;
+        _preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    }
+
+    virtual ~CLz4Compressor()
+    {
+        LZ4F_freeCompressionContext(_context);
+    }
+
+    virtual void compress(const char* data, size_t size, int mode, std::string* out)
+    {
+        size_t old_size;
+        if (!_started)
+        {
+            char* header = grow_output(out, LZ4F_HEADER_SIZE_MAX, &old_size);
+            const size_t bytes = LZ4F_compressBegin(_context, header, LZ4F_HEADER_SIZE_MAX, &_preferences);
+            out->resize(old_size + (LZ4F_isError(bytes)? 0: bytes));
+            check_lz4_result(bytes, "LZ4F_compressBegin");
+            _started = true;
+        }
+
+        // 分段输入，使每次需要的输出空间有限
+        for (size_t offset=0; offset<size;)
+        {
+            const size_t amount = (size - offset > static_cast<size_t>(SIZE_1M))? static_cast<size_t>(SIZE_1M): size - offset;
+            const size_t bound = LZ4F_compressBound(amount, &_preferences);
+            char* output = grow_output(out, bound, &old_size);
+            const size_t bytes = LZ4F_compressUpdate(_context, output, bound, data + offset, amount, NULL);
+            out->resize(old_size + (LZ4F_isError(bytes)? 0: bytes));
+            check_lz4_result(bytes, "LZ4F_compressUpdate");
+            offset += amount;
+        }
+
+        if (mode != MODE_CONTINUE)
+        {
+            const size_t bound = LZ4F_compressBound(0, &_preferences);
+            char* output = grow_output(out, bound, &old_size);
+            const size_t bytes = (MODE_FINISH == mode)? LZ4F_compressEnd(_context, output, bound, NULL): LZ4F_flush(_context, output, bound, NULL);
+            out->resize(old_size + (LZ4F_isError(bytes)? 0: bytes));
+            check_lz4_result(bytes, (MODE_FINISH == mode)? "LZ4F_compressEnd": "LZ4F_flush");
+            if (MODE_FINISH == mode)
+                _started = false;
+        }
+    }
+
+    virtual void reset()
+    {
+        _started = false;
+    }
+
+private:
+    LZ4F_cctx* _context;
+    LZ4F_preferences_t _preferences;
+    bool _started;
+};
+
+class CLz4Decompressor: public CDecompressor::Backend
+{
+public:
+    CLz4Decompressor(const std::string& dictionary)
+        : _finished(false)
+    {
+        if (!dictionary.empty())
+            THROW_EXCEPTION("lz4 does not support dictionary", EINVAL);
+        check_lz4_result(LZ4F_createDecompressionContext(&_context, LZ4F_VERSION), "LZ4F_createDecompressionContext");
+    }
+
+    virtual ~CLz4Decompressor()
+    {
+        LZ4F_freeDecompressionContext(_context);
+    }
+
+    virtual bool decompress(const char* data, size_t size, std::string* out)
+    {
+        size_t offset = 0;
+        for (;;)
+        {
+            size_t old_size;
+            size_t output_size = get_chunk_size(size * 2);
+            size_t input_size = size - offset;
+            char* output = grow_output(out, output_size, &old_size);
+            const size_t result = LZ4F_decompress(_context, output, &output_size, data + offset, &input_size, NULL);
+            out->resize(old_size + (LZ4F_isError(result)? 0: output_size));
+            check_lz4_result(result, "LZ4F_decompress");
+
+            offset += input_size;
+            if (0 == result)
+                _finished = true;
+            else if ((input_size > 0) || (output_size > 0))
+                _finished = false;
+            // 输入用完且没有再输出时结束，帧解完后上下文自动准备好解下一帧
+            if ((offset == size) && (0 == output_size))
+                break;
+        }
+        return _finished;
+    }
+
+    virtual void reset()
+    {
+        LZ4F_resetDecompressionContext(_context);
+        _finished = false;
+    }
+
+private:
+    LZ4F_dctx* _context;
+    bool _finished;
+};
+#endif // MOOON_HAVE_LZ4
+
+////////////////////////////////////////////////////////////////////////////////
+static void check_compression(compression_t compression)
+{
+    if ((compression < compression_none) || (compression >= compression_max))
+        THROW_EXCEPTION(CStringUtils::format_string("invalid compression: %d", static_cast<int>(compression)), EINVAL);
+    if (!is_compression_supported(compression))
+        THROW_EXCEPTION(CStringUtils::format_string("compression %s not supported, library not found when building", get_compression_name(compression)), ENOTSUP);
+}
+
+CCompressor::CCompressor(compression_t compression, int level, const std::string& dictionary)
+    : _compression(compression), _level(level), _backend(NULL)
+{
+    check_compression(compression);
+    switch (compression)
+    {
+    case compression_gzip:
+    case compression_zlib:
+        _backend = new CZlibCompressor(compression_gzip == compression, level, dictionary);
+        break;
+#if MOOON_HAVE_ZSTD == 1
+    case compression_zstd:
+        _backend = new CZstdCompressor(level, dictionary);
+        break;
+#endif // MOOON_HAVE_ZSTD
+#if MOOON_HAVE_LZ4 == 1
+    case compression_lz4:
+        _backend = new CLz4Compressor(level, dictionary);
+        break;
+#endif // MOOON_HAVE_LZ4
+    default:
+        _backend = new CNoneCompressor;
+        break;
+    }
+}
+
+CCompressor::~CCompressor()
+{
+    delete _backend;
+}
+
+void CCompressor::compress(const char* data, size_t size, std::string* out)
+{
+    _backend->compress(data, size, MODE_CONTINUE, out);
+}
+
+void CCompressor::flush(std::string* out)
+{
+    _backend->compress(NULL, 0, MODE_FLUSH, out);
+}
+
+void CCompressor::finish(std::string* out)
+{
+    _backend->compress(NULL, 0, MODE_FINISH, out);
+}
+
+void CCompressor::reset()
+{
+    _backend->reset();
+}
+
+CDecompressor::CDecompressor(compression_t compression, const std::string& dictionary)
+    : _compression(compression), _backend(NULL)
+{
+    check_compression(compression);
+    switch (compression)
+    {
+    case compression_gzip:
+    case compression_zlib:
+        _backend = new CZlibDecompressor(dictionary);
+        break;
+#if MOOON_HAVE_ZSTD == 1
+    case compression_zstd:
+        _backend = new CZstdDecompressor(dictionary);
+        break;
+#endif // MOOON_HAVE_ZSTD
+#if MOOON_HAVE_LZ4 == 1
+    case compression_lz4:
+        _backend = new CLz4Decompressor(dictionary);
+        break;
+#endif // MOOON_HAVE_LZ4
+    default:
+        _backend = new CNoneDecompressor;
+        break;
+    }
+}
+
+CDecompressor::~CDecompressor()
+{
+    delete _backend;
+}
+
+bool CDecompressor::decompress(const char* data, size_t size, std::string* out)
+{
+    return _backend->decompress(data, size, out);
+}
+
+void CDecompressor::reset()
+{
+    _backend->reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 每个线程每种方式各一个压缩器和解压器，线程退出时销毁
+struct ThreadCodecs
+{
+    CCompressor* compressors[compression_max];
+    CDecompressor* decompressors[compression_max];
+};
+
+static pthread_key_t sg_thread_codecs_key;
+static pthread_once_t sg_thread_codecs_once = PTHREAD_ONCE_INIT;
+
+static void delete_thread_codecs(void* param)
+{
+    ThreadCodecs* codecs = static_cast<ThreadCodecs*>(param);
+    for (int i=0; i<compression_max; ++i)
+    {
+        delete codecs->compressors[i];
+        delete codecs->decompressors[i];
+    }
+    delete codecs;
+}
+
+static void create_thread_codecs_key()
+{
+    (void)pthread_key_create(&sg_thread_codecs_key, delete_thread_codecs);
+}
+
+static ThreadCodecs* get_thread_codecs(compression_t compression)
+{
+    check_compression(compression);
+    (void)pthread_once(&sg_thread_codecs_once, create_thread_codecs_key);
+
+    ThreadCodecs* codecs = static_cast<ThreadCodecs*>(pthread_getspecific(sg_thread_codecs_key));
+    if (NULL == codecs)
+    {
+        codecs = new ThreadCodecs;
+        memset(codecs, 0, sizeof(ThreadCodecs));
+        (void)pthread_setspecific(sg_thread_codecs_key, codecs);
+    }
+    return codecs;
+}
+
+CCompressor* CCompressor::get_thread_compressor(compression_t compression, int level)
+{
+    ThreadCodecs* codecs = get_thread_codecs(compression);
+    CCompressor*& compressor = codecs->compressors[compression];
+
+    // 级别不同时重建，同一线程通常总用同一个级别
+    if ((compressor != NULL) && (compressor->get_level() != level))
+    {
+        delete compressor;
+        compressor = NULL;
+    }
+    if (NULL == compressor)
+        compressor = new CCompressor(compression, level);
+    else
+        compressor->reset();
+    return compressor;
+}
+
+CDecompressor* CDecompressor::get_thread_decompressor(compression_t compression)
+{
+    ThreadCodecs* codecs = get_thread_codecs(compression);
+    CDecompressor*& decompressor = codecs->decompressors[compression];
+
+    if (NULL == decompressor)
+        decompressor = new CDecompressor(compression);
+    else
+        decompressor->reset();
+    return decompressor;
+}
+
+void compress_data(compression_t compression, const char* data, size_t size, std::string* out, int level)
+{
+    CCompressor* compressor = CCompressor::get_thread_compressor(compression, level);
+    compressor->compress(data, size, out);
+    compressor->finish(out);
+}
+
+void decompress_data(compression_t compression, const char* data, size_t size, std::string* out)
+{
+    CDecompressor* decompressor = CDecompressor::get_thread_decompressor(compression);
+    const std::string::size_type old_size = out->size();
+
+    bool finished = false;
+
+    // 出错时不留下解出的部分数据
+    try
+    {
+        finished = decompressor->decompress(data, size, out);
+    }
+    catch (CException&)
+    {
+        out->resize(old_size);
+        throw;
+    }
+    if (!finished)
+    {
+        out->resize(old_size);
+        THROW_EXCEPTION(CStringUtils::format_string("%s data incomplete", get_compression_name(compression)), EINVAL);
+    }
+}
+
+UTILS_NAMESPACE_END
@@ -0,0 +1,278 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/crc32.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MOOON_CRC32_SIMD 1
+#else
+#define MOOON_CRC32_SIMD 0
+#endif
+UTILS_NAMESPACE_BEGIN
+
+////////////////////////////////////////////////////////////////////////////////
+// slice-by-8的查找表，tables[0]即逐字节计算用的表，
+// tables[k][i]为字节i之后再跟k个0字节的CRC，一次可处理8个字节
+struct SliceTables
+{
+    uint32_t tables[8][256];
+
+    explicit SliceTables(uint32_t reflected_polynomial)
+    {
+        for (uint32_t i=0; i<256; ++i)
+        {
+            uint32_t crc = i;
+            for (int j=0; j<8; ++j)
+                crc = (crc >> 1) ^ ((crc & 1)? reflected_polynomial: 0);
+            tables[0][i] = crc;
+        }
+        for (uint32_t i=0; i<256; ++i)
+        {
+            for (int k=1; k<8; ++k)
+                tables[k][i] = (tables[k-1][i] >> 8) ^ tables[0][tables[k-1][i] & 0xFF];
+        }
+    }
+};
+
+static const SliceTables& get_slice_tables(CCrc32::polynomial_t polynomial)
+{
+    static const SliceTables ieee_tables(0xEDB88320);
+    static const SliceTables castagnoli_tables(0x82F63B78);
+    return (CCrc32::poly_castagnoli == polynomial)? castagnoli_tables: ieee_tables;
+}
+
+// crc为取反后的中间值
+static uint32_t slice_by_8(const SliceTables& slice_tables, const unsigned char* data, size_t size, uint32_t crc)
+{
+    const uint32_t (*t)[256] = slice_tables.tables;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    for (; (size > 0) && (reinterpret_cast<uintptr_t>(data) & 7); --size)
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+    for (; size>=8; size-=8)
+    {
+        uint32_t low, high;
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data+4, sizeof(high));
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+    }
+#endif // __BYTE_ORDER__
+
+    for (; size>0; --size)
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if MOOON_CRC32_SIMD == 1
+////////////////////////////////////////////////////////////////////////////////
+// SSE4.2的crc32指令，只支持CRC32C
+__attribute__((target("sse4.2")))
+static uint32_t hardware_crc32c(const unsigned char* data, size_t size, uint32_t crc)
+{
+    for (; (size > 0) && (reinterpret_cast<uintptr_t>(data) & 7); --size)
+        crc = _mm_crc32_u8(crc, *data++);
+
+    uint64_t crc64 = crc;
+    for (; size>=8; size-=8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+    }
+
+    crc = static_cast<uint32_t>(crc64);
+    for (; size>0; --size)
+        crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+
+// 用PCLMULQDQ每次并行折叠64字节，最后以Barrett约简得到CRC32，
+// 常量为位反射域下的x^(k)模P的值，见Intel白皮书《Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction》，
+// size须不小于64且为16的倍数
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t pclmul_crc32(const unsigned char* data, size_t size, uint32_t crc)
+{
+    static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    data += 64;
+    size -= 64;
+
+    // 4路并行折叠
+    for (; size>=64; size-=64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+        data += 64;
+    }
+
+    // 折叠成128位
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // 剩下的每次折叠16字节
+    for (; size>=16; size-=16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), x5);
+        data += 16;
+    }
+
+    // 128位折叠成64位
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett约简成32位
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+#endif // MOOON_CRC32_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+struct Crc32Isa
+{
+    bool sse42;
+    bool pclmul;
+};
+
+static Crc32Isa detect_isa()
+{
+    Crc32Isa isa = { false, false };
+#if MOOON_CRC32_SIMD == 1
+    __builtin_cpu_init();
+    isa.sse42 = __builtin_cpu_supports("sse4.2");
+    isa.pclmul = isa.sse42 && __builtin_cpu_supports("pclmul");
+#endif // MOOON_CRC32_SIMD
+    return isa;
+}
+
+static Crc32Isa& get_isa()
+{
+    static Crc32Isa isa = detect_isa();
+    return isa;
+}
+
+CCrc32::CCrc32(polynomial_t polynomial, uint32_t crc)
+    : _polynomial(polynomial), _crc(crc)
+{
+}
+
+void CCrc32::update(const void* data, size_t size)
+{
+    _crc = checksum(_polynomial, data, size, _crc);
+}
+
+uint32_t CCrc32::checksum(polynomial_t polynomial, const void* data, size_t size, uint32_t crc)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const Crc32Isa& isa = get_isa();
+    crc = ~crc;
+
+#if MOOON_CRC32_SIMD == 1
+    if (poly_castagnoli == polynomial)
+    {
+        if (isa.sse42)
+            return ~hardware_crc32c(bytes, size, crc);
+    }
+    else if (isa.pclmul && (size >= 64))
+    {
+        const size_t folded_size = size & ~static_cast<size_t>(15);
+        crc = pclmul_crc32(bytes, folded_size, crc);
+        bytes += folded_size;
+        size -= folded_size;
+    }
+#endif // MOOON_CRC32_SIMD
+
+    return ~slice_by_8(get_slice_tables(polynomial), bytes, size, crc);
+}
+
+uint32_t CCrc32::crc32(const void* data, size_t size, uint32_t crc)
+{
+    return checksum(poly_ieee, data, size, crc);
+}
+
+uint32_t CCrc32::crc32c(const void* data, size_t size, uint32_t crc)
+{
+    return checksum(poly_castagnoli, data, size, crc);
+}
+
+bool CCrc32::is_hardware_accelerated(polynomial_t polynomial)
+{
+    return (poly_castagnoli == polynomial)? get_isa().sse42: get_isa().pclmul;
+}
+
+void CCrc32::set_software_only(bool software_only)
+{
+    Crc32Isa& isa = get_isa();
+    if (software_only)
+    {
+        isa.sse42 = false;
+        isa.pclmul = false;
+    }
+    else
+    {
+        isa = detect_isa();
+    }
+}
+
+UTILS_NAMESPACE_END
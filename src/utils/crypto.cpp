@@ -1,50 +1,39 @@
 // Writed by yijian on 2018/12/23
 #include "utils/crypto.h"
-#if MOOON_HAVE_OPENSSL == 1
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
-#include <openssl/evp.h>
+#include "utils/codec.h"
 UTILS_NAMESPACE_BEGIN
 
-// https://linux.die.net/man/3/bio
-// https://linux.die.net/man/3/bio_push
-// https://linux.die.net/man/3/bio_f_base64
-// https://linux.die.net/man/3/bio_write
+// 原基于OpenSSL的BIO_f_base64实现，结果与之相同：
+// 不指定no_newline时每64个字符一行，且以换行结尾
 void base64_encode(const std::string& src, std::string* dest, bool no_newline)
 {
-    BUF_MEM* bptr;
-    BIO* bmem = BIO_new(BIO_s_mem());
-    BIO* b64 = BIO_new(BIO_f_base64());
-
-    if (no_newline)
-        BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-    b64 = BIO_push(b64, bmem);
-    BIO_write(b64, src.data(), static_cast<int>(src.length()));
-    if (BIO_flush(b64));
-    BIO_get_mem_ptr(b64, &bptr);
-
-    dest->resize(bptr->length);
-    memcpy(const_cast<char*>(dest->data()), bptr->data, bptr->length);
-    BIO_free_all(b64);
+    *dest = CCodec::base64_encode(src);
+    if (!no_newline && !dest->empty())
+    {
+        std::string lines;
+        lines.reserve(dest->size() + dest->size()/64 + 1);
+        for (std::string::size_type i=0; i<dest->size(); i+=64)
+        {
+            lines.append(*dest, i, 64);
+            lines.push_back('\n');
+        }
+        dest->swap(lines);
+    }
 }
 
-// https://linux.die.net/man/3/bio_read
-// https://www.openssl.org/docs/man1.0.2/crypto/BIO_read.html
+// 总是跳过空白字符，所以no_newline不影响结果，src无效时dest为空
 void base64_decode(const std::string& src, std::string* dest, bool no_newline)
 {
-    BIO* bmem = BIO_new_mem_buf(const_cast<char*>(src.data()), static_cast<int>(src.length()));
-    BIO* b64 = BIO_new(BIO_f_base64());
-
-    if (no_newline)
-        BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-    bmem = BIO_push(b64, bmem);
-
-    dest->resize(src.length());
-    const int bytes = BIO_read(bmem, const_cast<char*>(dest->data()), static_cast<int>(src.length()));
-    dest->resize(bytes);
-    BIO_free_all(bmem);
-
+    CBase64Decoder decoder;
+    dest->resize(CCodec::base64_decoded_size_max(src.size()));
+
+    ssize_t n = decoder.update(src.data(), src.size(), &(*dest)[0]);
+    if (n >= 0)
+    {
+        const ssize_t tail = decoder.finish(&(*dest)[n]);
+        n = (tail < 0)? -1: n + tail;
+    }
+    dest->resize((n > 0)? static_cast<size_t>(n): 0);
 }
 
 UTILS_NAMESPACE_END
-#endif // MOOON_HAVE_OPENSSL
@@ -17,7 +17,12 @@
  * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
  */
 #include <limits>
+#include <string.h>
 #include "utils/integer_utils.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define MOOON_INTEGER_SSE2 1 // SSE2是x86_64的基本指令集，不需要运行时检测
+#endif
 UTILS_NAMESPACE_BEGIN
 
 bool CIntegerUtils::is_int16(int32_t num)
@@ -52,4 +57,422 @@ bool CIntegerUtils::is_uint32(uint64_t num)
     return (num <= std::numeric_limits<uint32_t>::max());
 }
 
+size_t CIntegerUtils::get_varint_size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+size_t CIntegerUtils::encode_varint(uint64_t value, char* buffer)
+{
+    unsigned char* output = reinterpret_cast<unsigned char*>(buffer);
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        output[size++] = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+    }
+    output[size++] = static_cast<unsigned char>(value);
+    return size;
+}
+
+size_t CIntegerUtils::decode_varint(const char* buffer, size_t size, uint64_t* value)
+{
+    const unsigned char* input = reinterpret_cast<const unsigned char*>(buffer);
+    uint64_t result = 0;
+    for (size_t i=0; (i<size) && (i<10); ++i)
+    {
+        result |= static_cast<uint64_t>(input[i] & 0x7F) << (7 * i);
+        if (0 == (input[i] & 0x80))
+        {
+            // 第10个字节只能有1位有效
+            if ((9 == i) && (input[i] > 1))
+                return 0;
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+size_t CIntegerUtils::decode_varint(const char* buffer, size_t size, uint32_t* value)
+{
+    uint64_t result;
+    const size_t bytes = decode_varint(buffer, size, &result);
+    if ((0 == bytes) || (result > std::numeric_limits<uint32_t>::max()))
+        return 0;
+    *value = static_cast<uint32_t>(result);
+    return bytes;
+}
+
+template <typename T>
+static void delta_encode_values(T* values, size_t n, T base)
+{
+    T previous = base;
+    for (size_t i=0; i<n; ++i)
+    {
+        const T current = values[i];
+        values[i] = current - previous;
+        previous = current;
+    }
+}
+
+template <typename T>
+static void delta_decode_values(T* values, size_t n, T base)
+{
+    T previous = base;
+    for (size_t i=0; i<n; ++i)
+    {
+        previous += values[i];
+        values[i] = previous;
+    }
+}
+
+void CIntegerUtils::delta_encode(uint32_t* values, size_t n, uint32_t base)
+{
+    delta_encode_values(values, n, base);
+}
+
+void CIntegerUtils::delta_encode(uint64_t* values, size_t n, uint64_t base)
+{
+    delta_encode_values(values, n, base);
+}
+
+void CIntegerUtils::delta_decode(uint32_t* values, size_t n, uint32_t base)
+{
+    delta_decode_values(values, n, base);
+}
+
+void CIntegerUtils::delta_decode(uint64_t* values, size_t n, uint64_t base)
+{
+    delta_decode_values(values, n, base);
+}
+
+uint32_t CIntegerUtils::get_max_bits(const uint32_t* values, size_t n)
+{
+    uint32_t bits = 0;
+    for (size_t i=0; i<n; ++i)
+        bits |= values[i];
+    return (0 == bits)? 0: 32 - __builtin_clz(bits);
+}
+
+uint32_t CIntegerUtils::get_max_bits(const uint64_t* values, size_t n)
+{
+    uint64_t bits = 0;
+    for (size_t i=0; i<n; ++i)
+        bits |= values[i];
+    return (0 == bits)? 0: 64 - __builtin_clzll(bits);
+}
+
+// 竖排：第r行的4个值（values[4r]到values[4r+3]）分别放入4路，
+// 每路是一个32位的位流，bits个128位字依次存放，每个字含4路各自的32位
+void CIntegerUtils::pack128(const uint32_t* values, uint32_t bits, char* buffer)
+{
+    if (0 == bits)
+        return;
+
+#if MOOON_INTEGER_SSE2
+    __m128i* output = reinterpret_cast<__m128i*>(buffer);
+    __m128i word = _mm_setzero_si128();
+    uint32_t shift = 0;
+
+    for (int row=0; row<32; ++row)
+    {
+        const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + row * 4));
+        word = _mm_or_si128(word, _mm_sll_epi32(value, _mm_cvtsi32_si128(shift)));
+        shift += bits;
+        if (shift >= 32)
+        {
+            _mm_storeu_si128(output++, word);
+            shift -= 32;
+            word = (0 == shift)? _mm_setzero_si128(): _mm_srl_epi32(value, _mm_cvtsi32_si128(bits - shift));
+        }
+    }
+#else
+    uint32_t word[4] = { 0, 0, 0, 0 };
+    uint32_t shift = 0;
+
+    for (int row=0; row<32; ++row)
+    {
+        const uint32_t* value = values + row * 4;
+        for (int lane=0; lane<4; ++lane)
+            word[lane] |= value[lane] << shift;
+        shift += bits;
+        if (shift >= 32)
+        {
+            memcpy(buffer, word, sizeof(word));
+            buffer += sizeof(word);
+            shift -= 32;
+            for (int lane=0; lane<4; ++lane)
+                word[lane] = (0 == shift)? 0: value[lane] >> (bits - shift);
+        }
+    }
+#endif // MOOON_INTEGER_SSE2
+}
+
+void CIntegerUtils::unpack128(const char* buffer, uint32_t bits, uint32_t* values)
+{
+    if (0 == bits)
+    {
+        memset(values, 0, sizeof(uint32_t) * 128);
+        return;
+    }
+
+    const uint32_t mask = (32 == bits)? 0xFFFFFFFFu: (1u << bits) - 1;
+    uint32_t index = 0; // 当前读的是第几个128位字
+    uint32_t shift = 0;
+
+#if MOOON_INTEGER_SSE2
+    const __m128i* input = reinterpret_cast<const __m128i*>(buffer);
+    const __m128i mask128 = _mm_set1_epi32(static_cast<int>(mask));
+    __m128i word = _mm_loadu_si128(input);
+
+    for (int row=0; row<32; ++row)
+    {
+        __m128i value = _mm_srl_epi32(word, _mm_cvtsi32_si128(shift));
+        shift += bits;
+        if (shift >= 32)
+        {
+            shift -= 32;
+            if (++index < bits)
+            {
+                word = _mm_loadu_si128(input + index);
+                if (shift > 0)
+                    value = _mm_or_si128(value, _mm_sll_epi32(word, _mm_cvtsi32_si128(bits - shift)));
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + row * 4), _mm_and_si128(value, mask128));
+    }
+#else
+    uint32_t word[4];
+    memcpy(word, buffer, sizeof(word));
+
+    for (int row=0; row<32; ++row)
+    {
+        uint32_t* value = values + row * 4;
+        for (int lane=0; lane<4; ++lane)
+            value[lane] = word[lane] >> shift;
+        shift += bits;
+        if (shift >= 32)
+        {
+            shift -= 32;
+            if (++index < bits)
+            {
+                memcpy(word, buffer + index * sizeof(word), sizeof(word));
+                if (shift > 0)
+                {
+                    for (int lane=0; lane<4; ++lane)
+                        value[lane] |= word[lane] << (bits - shift);
+                }
+            }
+        }
+        for (int lane=0; lane<4; ++lane)
+            value[lane] &= mask;
+    }
+#endif // MOOON_INTEGER_SSE2
+}
+
+// 64位的按小端字节序依次排列，每次最多写32位，累加器中不会超过39位
+void CIntegerUtils::pack128(const uint64_t* values, uint32_t bits, char* buffer)
+{
+    unsigned char* output = reinterpret_cast<unsigned char*>(buffer);
+    uint64_t accumulator = 0;
+    uint32_t accumulator_bits = 0;
+
+    if (0 == bits)
+        return;
+    for (int i=0; i<128; ++i)
+    {
+        uint64_t value = values[i];
+        for (uint32_t remaining=bits; remaining>0;)
+        {
+            const uint32_t chunk = (remaining > 32)? 32: remaining;
+            accumulator |= (value & ((UINT64_C(1) << chunk) - 1)) << accumulator_bits;
+            accumulator_bits += chunk;
+            value >>= chunk;
+            remaining -= chunk;
+            for (; accumulator_bits>=8; accumulator_bits-=8)
+            {
+                *output++ = static_cast<unsigned char>(accumulator);
+                accumulator >>= 8;
+            }
+        }
+    }
+}
+
+void CIntegerUtils::unpack128(const char* buffer, uint32_t bits, uint64_t* values)
+{
+    const unsigned char* input = reinterpret_cast<const unsigned char*>(buffer);
+    uint64_t accumulator = 0;
+    uint32_t accumulator_bits = 0;
+
+    for (int i=0; i<128; ++i)
+    {
+        uint64_t value = 0;
+        uint32_t value_bits = 0;
+        for (uint32_t remaining=bits; remaining>0;)
+        {
+            const uint32_t chunk = (remaining > 32)? 32: remaining;
+            for (; accumulator_bits<chunk; accumulator_bits+=8)
+                accumulator |= static_cast<uint64_t>(*input++) << accumulator_bits;
+            value |= (accumulator & ((UINT64_C(1) << chunk) - 1)) << value_bits;
+            accumulator >>= chunk;
+            accumulator_bits -= chunk;
+            value_bits += chunk;
+            remaining -= chunk;
+        }
+        values[i] = value;
+    }
+}
+
+size_t CIntegerUtils::get_max_compressed_size(size_t n, size_t value_size)
+{
+    // 打包的块（最小值的varint、位数和bits*16字节）不会比逐个varint大
+    const size_t max_varint_size = (value_size * 8 + 6) / 7;
+    return 1 + 10 + n * max_varint_size;
+}
+
+// 压缩后的格式：方式（1字节）、个数（varint），
+// 打包方式时每128个一块：块内最小值（varint）、位数（1字节）和位数*16字节的打包数据，
+// 不足128个的尾部以varint逐个存放
+template <typename T>
+static size_t compress_values(const T* values, size_t n, char* buffer, integer_codec_t codec)
+{
+    size_t size = 0;
+    buffer[size++] = static_cast<char>(codec);
+    size += CIntegerUtils::encode_varint(n, buffer + size);
+
+    if (integer_codec_varint == codec)
+    {
+        for (size_t i=0; i<n; ++i)
+            size += CIntegerUtils::encode_varint(values[i], buffer + size);
+        return size;
+    }
+
+    T block[128];
+    T previous = 0;
+    size_t i = 0;
+    for (; i+128<=n; i+=128)
+    {
+        memcpy(block, values + i, sizeof(block));
+        if (integer_codec_delta == codec)
+        {
+            CIntegerUtils::delta_encode(block, 128, previous);
+            previous = values[i + 127];
+        }
+
+        T min_value = block[0];
+        for (int j=1; j<128; ++j)
+        {
+            if (block[j] < min_value)
+                min_value = block[j];
+        }
+        for (int j=0; j<128; ++j)
+            block[j] -= min_value;
+
+        const uint32_t bits = CIntegerUtils::get_max_bits(block, 128);
+        size += CIntegerUtils::encode_varint(min_value, buffer + size);
+        buffer[size++] = static_cast<char>(bits);
+        CIntegerUtils::pack128(block, bits, buffer + size);
+        size += bits * 16;
+    }
+    for (; i<n; ++i)
+    {
+        const T value = (integer_codec_delta == codec)? values[i] - previous: values[i];
+        previous = values[i];
+        size += CIntegerUtils::encode_varint(value, buffer + size);
+    }
+    return size;
+}
+
+template <typename T>
+static size_t decompress_values(const char* buffer, size_t size, T* values, size_t n, integer_codec_t codec)
+{
+    size_t offset = 0;
+    size_t i = 0;
+
+    if (integer_codec_varint != codec)
+    {
+        for (; i+128<=n; i+=128)
+        {
+            T min_value;
+            const size_t bytes = CIntegerUtils::decode_varint(buffer + offset, size - offset, &min_value);
+            if ((0 == bytes) || (offset + bytes >= size))
+                return 0;
+            offset += bytes;
+
+            const uint32_t bits = static_cast<unsigned char>(buffer[offset++]);
+            if ((bits > sizeof(T) * 8) || (offset + bits * 16 > size))
+                return 0;
+            CIntegerUtils::unpack128(buffer + offset, bits, values + i);
+            offset += bits * 16;
+            for (int j=0; j<128; ++j)
+                values[i + j] += min_value;
+        }
+    }
+    for (; i<n; ++i)
+    {
+        const size_t bytes = CIntegerUtils::decode_varint(buffer + offset, size - offset, values + i);
+        if (0 == bytes)
+            return 0;
+        offset += bytes;
+    }
+
+    if (integer_codec_delta == codec)
+        CIntegerUtils::delta_decode(values, n);
+    return offset;
+}
+
+template <typename T>
+static size_t decompress_values(const char* buffer, size_t size, std::vector<T>* values)
+{
+    if (size < 2)
+        return 0;
+
+    const integer_codec_t codec = static_cast<integer_codec_t>(static_cast<unsigned char>(buffer[0]));
+    if ((codec != integer_codec_varint) && (codec != integer_codec_for) && (codec != integer_codec_delta))
+        return 0;
+
+    uint64_t n;
+    const size_t header_size = 1 + CIntegerUtils::decode_varint(buffer + 1, size - 1, &n);
+    // 每个值至少占1字节（打包的块128个值至少2字节），避免损坏的个数导致分配过多内存
+    if ((1 == header_size) || (n / 64 > size) || ((integer_codec_varint == codec) && (n > size)))
+        return 0;
+
+    const size_t old_size = values->size();
+    values->resize(old_size + n);
+    const size_t bytes = decompress_values(buffer + header_size, size - header_size, values->data() + old_size, n, codec);
+    if ((0 == bytes) && (n > 0))
+    {
+        values->resize(old_size);
+        return 0;
+    }
+    return header_size + bytes;
+}
+
+size_t CIntegerUtils::compress(const uint32_t* values, size_t n, char* buffer, integer_codec_t codec)
+{
+    return compress_values(values, n, buffer, codec);
+}
+
+size_t CIntegerUtils::compress(const uint64_t* values, size_t n, char* buffer, integer_codec_t codec)
+{
+    return compress_values(values, n, buffer, codec);
+}
+
+size_t CIntegerUtils::decompress(const char* buffer, size_t size, std::vector<uint32_t>* values)
+{
+    return decompress_values(buffer, size, values);
+}
+
+size_t CIntegerUtils::decompress(const char* buffer, size_t size, std::vector<uint64_t>* values)
+{
+    return decompress_values(buffer, size, values);
+}
+
 UTILS_NAMESPACE_END
@@ -0,0 +1,333 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/json_writer.h"
+#include "utils/string_simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if (__cplusplus >= 201703L) && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+UTILS_NAMESPACE_BEGIN
+
+// 两位一组的十进制数字表，00~99
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// 须转义的字节转义后的第二个字符，'u'表示以\u00XX表示
+static inline char json_escape_char(unsigned char c)
+{
+    switch (c)
+    {
+    case '"':  return '"';
+    case '\\': return '\\';
+    case '\b': return 'b';
+    case '\f': return 'f';
+    case '\n': return 'n';
+    case '\r': return 'r';
+    case '\t': return 't';
+    default:   return 'u';
+    }
+}
+
+// 须转义的字节转义后写入buffer，返回写入的字节数（2或6）
+static inline size_t escape_byte(unsigned char c, char* buffer)
+{
+    const char e = json_escape_char(c);
+    buffer[0] = '\\';
+    buffer[1] = e;
+    if (e != 'u')
+        return 2;
+
+    buffer[2] = '0';
+    buffer[3] = '0';
+    buffer[4] = hex_digits[c >> 4];
+    buffer[5] = hex_digits[c & 0x0f];
+    return 6;
+}
+
+void CJsonWriter::escape(const char* str, size_t size, std::string* out)
+{
+    for (size_t i=0; i<size;)
+    {
+        const size_t n = CStringSimd::find_json_escape(str+i, size-i);
+        out->append(str+i, n);
+        i += n;
+        if (i < size)
+        {
+            char buffer[6];
+            out->append(buffer, escape_byte(static_cast<unsigned char>(str[i++]), buffer));
+        }
+    }
+}
+
+// 先从低位两位一组写到临时缓冲区的末尾，再整体复制
+size_t CJsonWriter::format_integer(uint64_t n, char* buffer)
+{
+    char digits[20];
+    char* p = digits + sizeof(digits);
+
+    while (n >= 100)
+    {
+        const unsigned int pair = static_cast<unsigned int>(n % 100) * 2;
+        n /= 100;
+        *--p = digit_pairs[pair+1];
+        *--p = digit_pairs[pair];
+    }
+    if (n >= 10)
+    {
+        const unsigned int pair = static_cast<unsigned int>(n) * 2;
+        *--p = digit_pairs[pair+1];
+        *--p = digit_pairs[pair];
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + n);
+    }
+
+    const size_t size = static_cast<size_t>(digits + sizeof(digits) - p);
+    memcpy(buffer, p, size);
+    return size;
+}
+
+size_t CJsonWriter::format_integer(int64_t n, char* buffer)
+{
+    if (n >= 0)
+        return format_integer(static_cast<uint64_t>(n), buffer);
+
+    // 取反前先转成无符号数，INT64_MIN也不会溢出
+    buffer[0] = '-';
+    return 1 + format_integer(~static_cast<uint64_t>(n) + 1, buffer+1);
+}
+
+CJsonWriter::CJsonWriter(std::string* str)
+    : _string_sink(str), _sink(&_string_sink), _size(0), _after_key(false)
+{
+}
+
+CJsonWriter::CJsonWriter(CJsonSink* sink)
+    : _string_sink(NULL), _sink(sink), _size(0), _after_key(false)
+{
+}
+
+CJsonWriter::~CJsonWriter()
+{
+    flush();
+}
+
+CJsonWriter& CJsonWriter::begin_object()
+{
+    prefix();
+    put('{');
+    _first.push_back(true);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::end_object()
+{
+    put('}');
+    _first.pop_back();
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::begin_array()
+{
+    prefix();
+    put('[');
+    _first.push_back(true);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::end_array()
+{
+    put(']');
+    _first.pop_back();
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::key(const char* str, size_t size)
+{
+    prefix();
+    write_string(str, size);
+    put(':');
+    _after_key = true;
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::key(const char* str)
+{
+    return key(str, strlen(str));
+}
+
+CJsonWriter& CJsonWriter::value(const char* str, size_t size)
+{
+    prefix();
+    write_string(str, size);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::value(const char* str)
+{
+    if (NULL == str)
+        return null_value();
+    return value(str, strlen(str));
+}
+
+CJsonWriter& CJsonWriter::value(bool b)
+{
+    prefix();
+    if (b)
+        put("true", sizeof("true")-1);
+    else
+        put("false", sizeof("false")-1);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::value(int64_t n)
+{
+    prefix();
+    reserve(24);
+    _size += format_integer(n, _buffer+_size);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::value(uint64_t n)
+{
+    prefix();
+    reserve(24);
+    _size += format_integer(n, _buffer+_size);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::value(double d)
+{
+    if (!isfinite(d))
+        return null_value();
+
+    prefix();
+    reserve(32);
+#if defined(__cpp_lib_to_chars) && (__cpp_lib_to_chars >= 201611L)
+    // 最短的可精确还原的表示，比%.17g快数倍且更短
+    const std::to_chars_result result = std::to_chars(_buffer+_size, _buffer+_size+32, d);
+    _size = static_cast<size_t>(result.ptr - _buffer);
+#else
+    _size += static_cast<size_t>(snprintf(_buffer+_size, 32, "%.17g", d));
+#endif // __cpp_lib_to_chars
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::null_value()
+{
+    prefix();
+    put("null", sizeof("null")-1);
+    return *this;
+}
+
+CJsonWriter& CJsonWriter::raw_value(const char* json, size_t size)
+{
+    prefix();
+    put(json, size);
+    return *this;
+}
+
+void CJsonWriter::flush()
+{
+    if (_size > 0)
+    {
+        _sink->append(_buffer, _size);
+        _size = 0;
+    }
+}
+
+// 数组和对象中第二个及之后的成员前加逗号，key之后的值不加
+void CJsonWriter::prefix()
+{
+    if (_after_key)
+    {
+        _after_key = false;
+    }
+    else if (!_first.empty())
+    {
+        if (_first.back())
+            _first.back() = false;
+        else
+            put(',');
+    }
+}
+
+void CJsonWriter::write_string(const char* str, size_t size)
+{
+    put('"');
+    for (size_t i=0; i<size;)
+    {
+        const size_t n = CStringSimd::find_json_escape(str+i, size-i);
+        put(str+i, n);
+        i += n;
+        if (i < size)
+        {
+            reserve(6);
+            _size += escape_byte(static_cast<unsigned char>(str[i++]), _buffer+_size);
+        }
+    }
+    put('"');
+}
+
+void CJsonWriter::reserve(size_t size)
+{
+    if (_size + size > sizeof(_buffer))
+        flush();
+}
+
+// 大块数据不经过缓冲区，直接交给sink
+void CJsonWriter::put(const char* data, size_t size)
+{
+    if (_size + size <= sizeof(_buffer))
+    {
+        memcpy(_buffer+_size, data, size);
+        _size += size;
+    }
+    else
+    {
+        flush();
+        if (size < sizeof(_buffer) / 2)
+        {
+            memcpy(_buffer, data, size);
+            _size = size;
+        }
+        else
+        {
+            _sink->append(data, size);
+        }
+    }
+}
+
+UTILS_NAMESPACE_END
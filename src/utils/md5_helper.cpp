@@ -19,6 +19,9 @@
 #include "mooon/utils/md5_helper.h"
 #include "md5.h"
 #include "mooon/utils/scoped_ptr.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 UTILS_NAMESPACE_BEGIN
 
 std::string CMd5Helper::md5(const char* format, ...)
@@ -108,6 +111,13 @@ std::string CMd5Helper::uppercase_md5(const char* format, ...)
     return md5_helper.to_string(true);
 }
 
+void CMd5Helper::digest(const void* data, size_t size, unsigned char digest[16])
+{
+    CMd5Helper md5_helper;
+    md5_helper.update(static_cast<const char*>(data), size);
+    md5_helper.to_bytes(digest);
+}
+
 CMd5Helper::CMd5Helper()
 {
     _md5_context = new struct MD5Context;
@@ -121,6 +131,10 @@ CMd5Helper::~CMd5Helper()
 
 void CMd5Helper::update(const char* str, size_t size)
 {
+    // MD5Update的长度为unsigned int
+    static const size_t max_size = 1024*1024*1024;
+    for (; size>max_size; size-=max_size, str+=max_size)
+        MD5Update((struct MD5Context*)_md5_context, (unsigned char const *)str, max_size);
     MD5Update((struct MD5Context*)_md5_context, (unsigned char const *)str, size);
 }
 
@@ -129,20 +143,29 @@ void CMd5Helper::update(const std::string& str)
 	update(str.c_str(), str.size());
 }
 
+void CMd5Helper::update(const struct iovec* iov, int iovcnt)
+{
+    for (int i=0; i<iovcnt; ++i)
+        update(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+}
+
+void CMd5Helper::reset()
+{
+    MD5Init((struct MD5Context*)_md5_context);
+}
+
 void CMd5Helper::to_string(char str[33], bool uppercase) const
 {
+    static const char lower_hex_table[] = "0123456789abcdef";
+    static const char upper_hex_table[] = "0123456789ABCDEF";
+    const char* hex_table = uppercase? upper_hex_table: lower_hex_table;
     unsigned char digest[16];
-    struct MD5Context md5_context;
-
-    memcpy(&md5_context, _md5_context, sizeof(struct MD5Context));
-    MD5Final(digest, &md5_context); // MD5Final会修改md5_context
 
+    to_bytes(digest);
     for (int i=0; i<16; ++i)
     {
-    	if (uppercase)
-    		(void)snprintf(str + i*2, 3, "%02X", digest[i]);
-    	else
-    		(void)snprintf(str + i*2, 3, "%02x", digest[i]);
+        str[i*2] = hex_table[digest[i] >> 4];
+        str[i*2+1] = hex_table[digest[i] & 0x0F];
     }
 
     str[32] = '\0';
@@ -152,25 +175,24 @@ std::string CMd5Helper::to_string(bool uppercase) const
 {
 	char str[33];
 	to_string(str, uppercase);
-#if __cplusplus < 201103L
-    return str;
-#else
-    return std::move(str);
-#endif // __cplusplus < 201103L
+    return std::string(str, 32);
 }
 
+// MD5Final会修改上下文，因此在副本上进行
 void CMd5Helper::to_bytes(unsigned char str[16]) const
 {
-    MD5Final(str, (struct MD5Context*)_md5_context);
+    struct MD5Context md5_context;
+    memcpy(&md5_context, _md5_context, sizeof(struct MD5Context));
+    MD5Final(str, &md5_context);
 }
 
 void CMd5Helper::to_int(uint64_t* low_8bytes, uint64_t* high_8bytes) const
 {
     unsigned char digest[16];
-    MD5Final(digest, (struct MD5Context*)_md5_context);
+    to_bytes(digest);
 
-    *low_8bytes = *(uint64_t*)digest;
-    *high_8bytes =  *(uint64_t*)(digest+sizeof(uint64_t));
+    memcpy(low_8bytes, digest, sizeof(uint64_t));
+    memcpy(high_8bytes, digest+sizeof(uint64_t), sizeof(uint64_t));
 }
 
 struct CMd5Helper::Value CMd5Helper::value() const
@@ -183,25 +205,246 @@ struct CMd5Helper::Value CMd5Helper::value() const
 uint64_t CMd5Helper::low_8bytes() const
 {
     unsigned char digest[16];
-    MD5Final(digest, (struct MD5Context*)_md5_context);
-
-    return *(uint64_t*)digest;
+    uint64_t n;
+    to_bytes(digest);
+    memcpy(&n, digest, sizeof(n));
+    return n;
 }
 
 uint64_t CMd5Helper::high_8bytes() const
 {
     unsigned char digest[16];
-    MD5Final(digest, (struct MD5Context*)_md5_context);
-
-    return *(uint64_t*)(digest + sizeof(uint64_t));
+    uint64_t n;
+    to_bytes(digest);
+    memcpy(&n, digest+sizeof(uint64_t), sizeof(n));
+    return n;
 }
 
 uint64_t CMd5Helper::middle_8bytes() const
 {
     unsigned char digest[16];
-    MD5Final(digest, (struct MD5Context*)_md5_context);
+    uint64_t n;
+    to_bytes(digest);
+    memcpy(&n, digest+sizeof(uint32_t), sizeof(n));
+    return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 多缓冲MD5：8个消息各占AVX2寄存器的一个32位通道，
+// 每轮每个通道处理自己消息的一个64字节块，消息处理完的通道立即换上下一个消息
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// 每个通道的状态
+struct Md5Lane
+{
+    const unsigned char* data;
+    size_t full_blocks;  // 消息中完整的64字节块数
+    size_t total_blocks; // 加上填充后的块数
+    size_t block;        // 下一个要处理的块
+    size_t index;        // 消息的序号
+    unsigned char tail[128]; // 最后不足64字节的数据加上填充
+};
+
+static const uint32_t md5_k[64] =
+{
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const int md5_s[64] =
+{
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static const uint32_t md5_init_state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+// 准备第index个消息，返回false表示没有消息了
+static bool assign_lane(Md5Lane* lane, const struct iovec* messages, size_t count, size_t index)
+{
+    if (index >= count)
+    {
+        lane->total_blocks = 0;
+        return false;
+    }
+
+    const size_t size = messages[index].iov_len;
+    const size_t remaining = size % 64;
+    const uint64_t bits = static_cast<uint64_t>(size) * 8;
+
+    lane->data = static_cast<const unsigned char*>(messages[index].iov_base);
+    lane->full_blocks = size / 64;
+    lane->total_blocks = lane->full_blocks + ((remaining < 56)? 1: 2);
+    lane->block = 0;
+    lane->index = index;
+
+    // 填充：0x80，若干0，最后8字节为小端的位数
+    const size_t tail_size = (lane->total_blocks - lane->full_blocks) * 64;
+    memset(lane->tail, 0, tail_size);
+    if (remaining > 0)
+        memcpy(lane->tail, lane->data+lane->full_blocks*64, remaining);
+    lane->tail[remaining] = 0x80;
+    for (int i=0; i<8; ++i)
+        lane->tail[tail_size-8+i] = static_cast<unsigned char>(bits >> (i*8));
+    return true;
+}
+
+static inline uint32_t load_le32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+         | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rotl_epi32(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32-n));
+}
+
+__attribute__((target("avx2")))
+static void avx2_multi_digest(const struct iovec* messages, size_t count, unsigned char (*digests)[16])
+{
+    static const unsigned char zero_block[64] = { 0 };
+    Md5Lane lanes[8];
+    uint32_t state[4][8];
+    size_t next_index = 0;
+    int active_number = 0;
+
+    for (int lane=0; lane<8; ++lane)
+    {
+        if (assign_lane(&lanes[lane], messages, count, next_index))
+        {
+            ++next_index;
+            ++active_number;
+        }
+        for (int i=0; i<4; ++i)
+            state[i][lane] = md5_init_state[i];
+    }
+
+    while (active_number > 0)
+    {
+        // 转置：w[j]的第lane个通道为该通道当前块的第j个字
+        const unsigned char* blocks[8];
+        for (int lane=0; lane<8; ++lane)
+        {
+            const Md5Lane& l = lanes[lane];
+            if (l.block >= l.total_blocks)
+                blocks[lane] = zero_block;
+            else if (l.block < l.full_blocks)
+                blocks[lane] = l.data + l.block*64;
+            else
+                blocks[lane] = l.tail + (l.block-l.full_blocks)*64;
+        }
+
+        __m256i w[16];
+        for (int j=0; j<16; ++j)
+        {
+            w[j] = _mm256_setr_epi32(
+                static_cast<int>(load_le32(blocks[0]+j*4)), static_cast<int>(load_le32(blocks[1]+j*4)),
+                static_cast<int>(load_le32(blocks[2]+j*4)), static_cast<int>(load_le32(blocks[3]+j*4)),
+                static_cast<int>(load_le32(blocks[4]+j*4)), static_cast<int>(load_le32(blocks[5]+j*4)),
+                static_cast<int>(load_le32(blocks[6]+j*4)), static_cast<int>(load_le32(blocks[7]+j*4)));
+        }
+
+        const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[0]));
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[1]));
+        const __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[2]));
+        const __m256i d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[3]));
+        const __m256i ones = _mm256_set1_epi32(-1);
+        __m256i a = a0, b = b0, c = c0, d = d0;
+
+        for (int i=0; i<64; ++i)
+        {
+            __m256i f;
+            int g;
+            if (i < 16)
+            {
+                f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)));
+                g = (5*i + 1) % 16;
+            }
+            else if (i < 48)
+            {
+                f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+                g = (3*i + 5) % 16;
+            }
+            else
+            {
+                f = _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, ones)));
+                g = (7*i) % 16;
+            }
+
+            f = _mm256_add_epi32(_mm256_add_epi32(f, a), _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(md5_k[i])), w[g]));
+            a = d;
+            d = c;
+            c = b;
+            b = _mm256_add_epi32(b, rotl_epi32(f, md5_s[i]));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[0]), _mm256_add_epi32(a, a0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[1]), _mm256_add_epi32(b, b0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[2]), _mm256_add_epi32(c, c0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[3]), _mm256_add_epi32(d, d0));
+
+        // 完成的通道输出结果并换上下一个消息
+        for (int lane=0; lane<8; ++lane)
+        {
+            Md5Lane& l = lanes[lane];
+            if (l.block >= l.total_blocks)
+                continue;
+            if (++l.block < l.total_blocks)
+                continue;
+
+            for (int i=0; i<4; ++i)
+            {
+                for (int k=0; k<4; ++k)
+                    digests[l.index][i*4+k] = static_cast<unsigned char>(state[i][lane] >> (k*8));
+                state[i][lane] = md5_init_state[i];
+            }
+            if (assign_lane(&l, messages, count, next_index))
+                ++next_index;
+            else
+                --active_number;
+        }
+    }
+}
+#endif // __x86_64__
+
+bool CMd5Helper::is_multi_buffer_accelerated()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif // __x86_64__
+}
+
+void CMd5Helper::multi_digest(const struct iovec* messages, size_t count, unsigned char (*digests)[16])
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    // 消息太少时并行的好处抵不上转置的开销
+    if ((count >= 4) && is_multi_buffer_accelerated())
+    {
+        avx2_multi_digest(messages, count, digests);
+        return;
+    }
+#endif // __x86_64__
 
-    return *(uint64_t*)(digest + sizeof(uint32_t));
+    for (size_t i=0; i<count; ++i)
+        digest(messages[i].iov_base, messages[i].iov_len, digests[i]);
 }
 
 UTILS_NAMESPACE_END
@@ -0,0 +1,655 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/regex_helper.h"
+#include "utils/string_utils.h"
+#include <ctype.h>
+#include <map>
+#include <pthread.h>
+#include <stdint.h>
+#if MOOON_HAVE_PCRE2 == 1
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif // MOOON_HAVE_PCRE2
+UTILS_NAMESPACE_BEGIN
+
+CRegexHelper::CRegexHelper(const char* pattern, int cflags)
+    : _pattern(pattern), _cflags(cflags)
+{
+    int errcode = regcomp(&_regex, pattern, cflags);
+    if (errcode != 0)
+        THROW_EXCEPTION(get_error_message(errcode), errcode);
+}
+
+CRegexHelper::~CRegexHelper()
+{
+    regfree(&_regex);
+}
+
+bool CRegexHelper::match(const char* str, int eflags) const
+{
+    regmatch_t match[1];
+    int errcode = regexec(&_regex, str, 1, match, eflags);
+    return (0 == errcode);
+}
+
+bool CRegexHelper::match(const char* data, size_t size, std::vector<regex_capture_t>* captures, int eflags) const
+{
+    const bool with_captures = (captures != NULL) && (0 == (_cflags & REG_NOSUB));
+    const size_t nmatch = with_captures? _regex.re_nsub + 1: 1;
+    regmatch_t stack_match[10];
+    std::vector<regmatch_t> heap_match;
+    regmatch_t* match = stack_match;
+
+    if (nmatch > sizeof(stack_match)/sizeof(stack_match[0]))
+    {
+        heap_match.resize(nmatch);
+        match = &heap_match[0];
+    }
+
+    // REG_STARTEND：匹配范围由match[0]指定，不要求以结尾符结束
+    match[0].rm_so = 0;
+    match[0].rm_eo = static_cast<regoff_t>(size);
+    if (regexec(&_regex, data, nmatch, match, eflags|REG_STARTEND) != 0)
+        return false;
+
+    if (captures != NULL)
+    {
+        captures->clear();
+        if (with_captures)
+        {
+            for (size_t i=0; i<nmatch; ++i)
+                captures->push_back(regex_capture_t(match[i].rm_so, match[i].rm_eo));
+        }
+    }
+    return true;
+}
+
+std::string CRegexHelper::get_error_message(int errcode) const
+{
+    char errbuf[1024];
+    regerror(errcode, &_regex, errbuf, sizeof(errbuf)-1);
+    return errbuf;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 键为cflags和模式
+static pthread_mutex_t regex_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::pair<int, std::string>, const CRegexHelper*> regex_cache;
+
+class CRegexCacheLock
+{
+public:
+    CRegexCacheLock() { pthread_mutex_lock(&regex_cache_mutex); }
+    ~CRegexCacheLock() { pthread_mutex_unlock(&regex_cache_mutex); }
+};
+
+const CRegexHelper* CRegexHelper::get_cached(const std::string& pattern, int cflags)
+{
+    const std::pair<int, std::string> key(cflags, pattern);
+    CRegexCacheLock lock;
+    std::map<std::pair<int, std::string>, const CRegexHelper*>::const_iterator iter = regex_cache.find(key);
+
+    if (iter != regex_cache.end())
+        return iter->second;
+
+    const CRegexHelper* regex = new CRegexHelper(pattern.c_str(), cflags);
+    regex_cache.insert(std::make_pair(key, regex));
+    return regex;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool is_regex_backend_supported(regex_backend_t backend)
+{
+    if (regex_posix == backend)
+        return true;
+#if MOOON_HAVE_PCRE2 == 1
+    if (regex_pcre2 == backend)
+        return true;
+#endif // MOOON_HAVE_PCRE2
+    return false;
+}
+
+struct CRegexSet::Rule
+{
+    std::string pattern;
+    std::string literal;
+    int cflags;
+    size_t group_number;
+    CRegexHelper* posix;
+#if MOOON_HAVE_PCRE2 == 1
+    pcre2_code* code;
+#endif // MOOON_HAVE_PCRE2
+
+    Rule()
+        : cflags(0), group_number(0), posix(NULL)
+    {
+#if MOOON_HAVE_PCRE2 == 1
+        code = NULL;
+#endif // MOOON_HAVE_PCRE2
+    }
+
+    ~Rule()
+    {
+        delete posix;
+#if MOOON_HAVE_PCRE2 == 1
+        if (code != NULL)
+            pcre2_code_free(code);
+#endif // MOOON_HAVE_PCRE2
+    }
+};
+
+// 一次match中复用的PCRE2匹配数据，按分组最多的规则创建，POSIX时为空
+class CRegexMatchData
+{
+public:
+    CRegexMatchData(regex_backend_t backend, size_t group_number)
+    {
+#if MOOON_HAVE_PCRE2 == 1
+        _match_data = NULL;
+        if (regex_pcre2 == backend)
+        {
+            _match_data = pcre2_match_data_create(static_cast<uint32_t>(group_number+1), NULL);
+            if (NULL == _match_data)
+                THROW_EXCEPTION("pcre2_match_data_create failed", -1);
+        }
+#endif // MOOON_HAVE_PCRE2
+    }
+
+    ~CRegexMatchData()
+    {
+#if MOOON_HAVE_PCRE2 == 1
+        if (_match_data != NULL)
+            pcre2_match_data_free(_match_data);
+#endif // MOOON_HAVE_PCRE2
+    }
+
+    bool match(const CRegexSet::Rule* rule, const char* data, size_t size, std::vector<regex_capture_t>* captures, int eflags) const
+    {
+        if (rule->posix != NULL)
+            return rule->posix->match(data, size, captures, eflags);
+
+#if MOOON_HAVE_PCRE2 == 1
+        uint32_t options = 0;
+        if (eflags & REG_NOTBOL)
+            options |= PCRE2_NOTBOL;
+        if (eflags & REG_NOTEOL)
+            options |= PCRE2_NOTEOL;
+
+        // 出错（如超出匹配限制）也当作不匹配
+        const int rc = pcre2_match(rule->code, reinterpret_cast<PCRE2_SPTR>(data), size, 0, options, _match_data, NULL);
+        if (rc < 0)
+            return false;
+
+        if (captures != NULL)
+        {
+            const PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(_match_data);
+            const size_t pairs = (0 == rc)? pcre2_get_ovector_count(_match_data): static_cast<size_t>(rc);
+
+            captures->clear();
+            if (0 == (rule->cflags & REG_NOSUB))
+            {
+                for (size_t i=0; i<=rule->group_number; ++i)
+                {
+                    if ((i < pairs) && (ovector[2*i] != PCRE2_UNSET))
+                        captures->push_back(regex_capture_t(static_cast<int>(ovector[2*i]), static_cast<int>(ovector[2*i+1])));
+                    else
+                        captures->push_back(regex_capture_t(-1, -1));
+                }
+            }
+        }
+        return true;
+#else
+        return false;
+#endif // MOOON_HAVE_PCRE2
+    }
+
+private:
+#if MOOON_HAVE_PCRE2 == 1
+    pcre2_match_data* _match_data;
+#endif // MOOON_HAVE_PCRE2
+};
+
+CRegexSet::CRegexSet(regex_backend_t backend)
+    : _backend(backend), _compiled(false), _max_group_number(0), _class_number(0)
+{
+    if (!is_regex_backend_supported(backend))
+        THROW_EXCEPTION(CStringUtils::format_string("regex backend(%d) not supported", static_cast<int>(backend)), -1);
+    memset(_classes, 0, sizeof(_classes));
+}
+
+CRegexSet::~CRegexSet()
+{
+    for (std::vector<Rule*>::size_type i=0; i<_rules.size(); ++i)
+        delete _rules[i];
+}
+
+int CRegexSet::add(const std::string& pattern, int cflags)
+{
+    Rule* rule = new Rule;
+    rule->pattern = pattern;
+    rule->cflags = cflags;
+
+    try
+    {
+        if (regex_posix == _backend)
+        {
+            rule->posix = new CRegexHelper(pattern.c_str(), cflags);
+            rule->group_number = rule->posix->get_group_number();
+        }
+#if MOOON_HAVE_PCRE2 == 1
+        else
+        {
+            uint32_t options = 0;
+            int errcode = 0;
+            PCRE2_SIZE erroffset = 0;
+
+            if (cflags & REG_ICASE)
+                options |= PCRE2_CASELESS;
+            if (cflags & REG_NEWLINE)
+                options |= PCRE2_MULTILINE;
+            if (cflags & REG_NOSUB)
+                options |= PCRE2_NO_AUTO_CAPTURE;
+
+            rule->code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.data()), pattern.size(), options, &errcode, &erroffset, NULL);
+            if (NULL == rule->code)
+            {
+                PCRE2_UCHAR errbuf[256];
+                pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
+                THROW_EXCEPTION(CStringUtils::format_string("compile `%s` error at %d: %s", pattern.c_str(), static_cast<int>(erroffset), reinterpret_cast<char*>(errbuf)), errcode);
+            }
+
+            // 不支持JIT的系统上解释执行
+            uint32_t capture_count = 0;
+            (void)pcre2_jit_compile(rule->code, PCRE2_JIT_COMPLETE);
+            pcre2_pattern_info(rule->code, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+            rule->group_number = capture_count;
+        }
+#endif // MOOON_HAVE_PCRE2
+    }
+    catch (CException&)
+    {
+        delete rule;
+        throw;
+    }
+
+    rule->literal = extract_literal(pattern, cflags, _backend);
+    if (rule->group_number > _max_group_number)
+        _max_group_number = rule->group_number;
+    _rules.push_back(rule);
+    _compiled = false;
+    return static_cast<int>(_rules.size() - 1);
+}
+
+void CRegexSet::compile()
+{
+    const uint32_t none = UINT32_MAX;
+    std::vector<std::vector<int> > outputs(1);
+
+    // 字节类：字面量中出现的字节各为一类（大小写同类），其它字节都为第0类
+    memset(_classes, 0, sizeof(_classes));
+    _class_number = 1;
+    _always.clear();
+    for (std::vector<Rule*>::size_type i=0; i<_rules.size(); ++i)
+    {
+        const std::string& literal = _rules[i]->literal;
+        for (std::string::size_type j=0; j<literal.size(); ++j)
+        {
+            const unsigned char c = static_cast<unsigned char>(literal[j]);
+            if (0 == _classes[c])
+            {
+                _classes[c] = static_cast<unsigned char>(_class_number++);
+                if (islower(c))
+                    _classes[toupper(c)] = _classes[c];
+            }
+        }
+    }
+
+    // 字典树
+    _delta.assign(_class_number, none);
+    for (std::vector<Rule*>::size_type i=0; i<_rules.size(); ++i)
+    {
+        const std::string& literal = _rules[i]->literal;
+        uint32_t state = 0;
+
+        if (literal.empty())
+        {
+            _always.push_back(static_cast<int>(i));
+            continue;
+        }
+        for (std::string::size_type j=0; j<literal.size(); ++j)
+        {
+            const uint32_t index = state * _class_number + _classes[static_cast<unsigned char>(literal[j])];
+            if (none == _delta[index])
+            {
+                _delta[index] = static_cast<uint32_t>(outputs.size());
+                _delta.resize(_delta.size() + _class_number, none);
+                outputs.push_back(std::vector<int>());
+            }
+            state = _delta[index];
+        }
+        outputs[state].push_back(static_cast<int>(i));
+    }
+
+    // 按广度优先求失败转移，同时补全转移表，使扫描时每个字节只查一次表
+    std::vector<uint32_t> fail(outputs.size(), 0);
+    std::vector<uint32_t> queue;
+    for (uint32_t c=0; c<_class_number; ++c)
+    {
+        if (none == _delta[c])
+            _delta[c] = 0;
+        else
+            queue.push_back(_delta[c]);
+    }
+    for (std::vector<uint32_t>::size_type head=0; head<queue.size(); ++head)
+    {
+        const uint32_t state = queue[head];
+        for (uint32_t c=0; c<_class_number; ++c)
+        {
+            const uint32_t next = _delta[state * _class_number + c];
+            const uint32_t fail_next = _delta[fail[state] * _class_number + c];
+
+            if (none == next)
+            {
+                _delta[state * _class_number + c] = fail_next;
+            }
+            else
+            {
+                fail[next] = fail_next;
+                outputs[next].insert(outputs[next].end(), outputs[fail_next].begin(), outputs[fail_next].end());
+                queue.push_back(next);
+            }
+        }
+    }
+
+    _output_offsets.clear();
+    _outputs.clear();
+    for (std::vector<std::vector<int> >::size_type i=0; i<outputs.size(); ++i)
+    {
+        _output_offsets.push_back(static_cast<uint32_t>(_outputs.size()));
+        _outputs.insert(_outputs.end(), outputs[i].begin(), outputs[i].end());
+    }
+    _output_offsets.push_back(static_cast<uint32_t>(_outputs.size()));
+    _compiled = true;
+}
+
+void CRegexSet::prefilter(const char* data, size_t size, std::vector<int>* candidates) const
+{
+    if (!_compiled)
+        THROW_EXCEPTION("CRegexSet not compiled", -1);
+
+    std::vector<unsigned char> hits(_rules.size(), 0);
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    uint32_t state = 0;
+
+    for (std::vector<int>::size_type i=0; i<_always.size(); ++i)
+        hits[_always[i]] = 1;
+    for (size_t i=0; i<size; ++i)
+    {
+        state = _delta[state * _class_number + _classes[bytes[i]]];
+        for (uint32_t j=_output_offsets[state]; j<_output_offsets[state+1]; ++j)
+            hits[_outputs[j]] = 1;
+    }
+
+    candidates->clear();
+    for (std::vector<unsigned char>::size_type i=0; i<hits.size(); ++i)
+    {
+        if (hits[i])
+            candidates->push_back(static_cast<int>(i));
+    }
+}
+
+int CRegexSet::match(const char* data, size_t size, std::vector<int>* ids, int eflags) const
+{
+    std::vector<int> candidates;
+    prefilter(data, size, &candidates);
+
+    const CRegexMatchData match_data(_backend, _max_group_number);
+    ids->clear();
+    for (std::vector<int>::size_type i=0; i<candidates.size(); ++i)
+    {
+        if (match_data.match(_rules[candidates[i]], data, size, NULL, eflags))
+            ids->push_back(candidates[i]);
+    }
+    return static_cast<int>(ids->size());
+}
+
+int CRegexSet::match(const char* data, size_t size, std::vector<regex_match_t>* matches, int eflags) const
+{
+    std::vector<int> candidates;
+    prefilter(data, size, &candidates);
+
+    const CRegexMatchData match_data(_backend, _max_group_number);
+    regex_match_t match;
+    matches->clear();
+    for (std::vector<int>::size_type i=0; i<candidates.size(); ++i)
+    {
+        if (match_data.match(_rules[candidates[i]], data, size, &match.captures, eflags))
+        {
+            match.id = candidates[i];
+            matches->push_back(match);
+        }
+    }
+    return static_cast<int>(matches->size());
+}
+
+int CRegexSet::match_first(const char* data, size_t size, std::vector<regex_capture_t>* captures, int eflags) const
+{
+    std::vector<int> candidates;
+    prefilter(data, size, &candidates);
+
+    const CRegexMatchData match_data(_backend, _max_group_number);
+    for (std::vector<int>::size_type i=0; i<candidates.size(); ++i)
+    {
+        if (match_data.match(_rules[candidates[i]], data, size, captures, eflags))
+            return candidates[i];
+    }
+    return -1;
+}
+
+const std::string& CRegexSet::get_pattern(int id) const
+{
+    return _rules[id]->pattern;
+}
+
+const std::string& CRegexSet::get_literal(int id) const
+{
+    return _rules[id]->literal;
+}
+
+// 跳过以pattern[i]开始的“[...]”，返回“]”之后的位置，不完整时返回npos
+static std::string::size_type skip_bracket(const std::string& pattern, std::string::size_type i, bool pcre)
+{
+    std::string::size_type j = i + 1;
+
+    if ((j < pattern.size()) && ('^' == pattern[j]))
+        ++j;
+    if ((j < pattern.size()) && (']' == pattern[j]))
+        ++j;
+    while (j < pattern.size())
+    {
+        if (']' == pattern[j])
+            return j + 1;
+
+        if (('[' == pattern[j]) && (j+1 < pattern.size()) && (strchr(":=.", pattern[j+1]) != NULL))
+        {
+            // [:alpha:]、[=a=]和[.-.]
+            const char end[3] = { pattern[j+1], ']', '\0' };
+            const std::string::size_type pos = pattern.find(end, j+2);
+            if (std::string::npos == pos)
+                return std::string::npos;
+            j = pos + 2;
+        }
+        else if (pcre && ('\\' == pattern[j]))
+        {
+            j += 2;
+        }
+        else
+        {
+            ++j;
+        }
+    }
+    return std::string::npos;
+}
+
+// 跳过以pattern[i]开始的“(...)”，返回“)”之后的位置，不完整时返回npos
+static std::string::size_type skip_group(const std::string& pattern, std::string::size_type i, bool pcre)
+{
+    std::string::size_type j = i;
+    int depth = 0;
+
+    while (j < pattern.size())
+    {
+        if ('\\' == pattern[j])
+        {
+            j += 2;
+        }
+        else if ('[' == pattern[j])
+        {
+            j = skip_bracket(pattern, j, pcre);
+            if (std::string::npos == j)
+                break;
+        }
+        else if ('(' == pattern[j])
+        {
+            ++depth;
+            ++j;
+        }
+        else if (')' == pattern[j])
+        {
+            ++j;
+            if (0 == --depth)
+                return j;
+        }
+        else
+        {
+            ++j;
+        }
+    }
+    return std::string::npos;
+}
+
+static void finish_literal(std::string* literal, std::string* longest)
+{
+    if (literal->size() > longest->size())
+        longest->swap(*literal);
+    literal->clear();
+}
+
+std::string CRegexSet::extract_literal(const std::string& pattern, int cflags, regex_backend_t backend)
+{
+    const bool pcre = (regex_pcre2 == backend);
+    std::string literal;  // 当前连续的字面量
+    std::string longest;
+    std::string::size_type i = 0;
+
+    // BRE的元字符以反斜杠转义，和ERE相反，不做提取；
+    // PCRE的内联选项（如“(?i)”和“(?x)”）、“\Q...\E”和“(*VERB)”会改变之后的语法，也不做提取
+    if (!pcre && (0 == (cflags & REG_EXTENDED)))
+        return std::string();
+    if (pcre && ((pattern.find("(?") != std::string::npos) ||
+                 (pattern.find("\\Q") != std::string::npos) ||
+                 (pattern.find("(*") != std::string::npos)))
+        return std::string();
+
+    while (i < pattern.size())
+    {
+        char c = pattern[i];
+        std::string::size_type next = i + 1;
+
+        switch (c)
+        {
+        case '|':
+            // 分组已整体跳过，这里是顶层的分支，没有所有匹配都必须包含的字面量
+            return std::string();
+
+        case '(':
+            finish_literal(&literal, &longest);
+            i = skip_group(pattern, i, pcre);
+            if (std::string::npos == i)
+                return std::string();
+            continue;
+
+        case '[':
+            finish_literal(&literal, &longest);
+            i = skip_bracket(pattern, i, pcre);
+            if (std::string::npos == i)
+                return std::string();
+            continue;
+
+        case '{':
+            // 跟在非字面量之后的重复次数
+            finish_literal(&literal, &longest);
+            i = pattern.find('}', i);
+            if (std::string::npos == i)
+                return std::string();
+            ++i;
+            continue;
+
+        case '.': case '^': case '$': case '*': case '+': case '?': case ')':
+            finish_literal(&literal, &longest);
+            ++i;
+            continue;
+
+        case '\\':
+            if (i+1 >= pattern.size())
+                return std::string();
+
+            // “\w”、“\d”、“\b”、“\1”和glibc的“\<”等不是字面量，其它为转义的字面量
+            c = pattern[i+1];
+            next = i + 2;
+            if (isalnum(static_cast<unsigned char>(c)) || (!pcre && (strchr("<>`'", c) != NULL)))
+            {
+                finish_literal(&literal, &longest);
+                i = next;
+                continue;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        // 非ASCII字节可能是多字节字符的一部分，之后的重复作用于整个字符，保守地不作为字面量
+        if (static_cast<unsigned char>(c) >= 0x80)
+        {
+            finish_literal(&literal, &longest);
+            i = next;
+            continue;
+        }
+
+        // 之后有“*”、“?”或“{”时可以不出现，有“+”时至少出现一次
+        const char quantifier = (next < pattern.size())? pattern[next]: '\0';
+        if (('*' == quantifier) || ('?' == quantifier) || ('{' == quantifier))
+        {
+            finish_literal(&literal, &longest);
+        }
+        else
+        {
+            literal.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+            if ('+' == quantifier)
+                finish_literal(&literal, &longest);
+        }
+        i = next;
+    }
+
+    finish_literal(&literal, &longest);
+    return longest;
+}
+
+UTILS_NAMESPACE_END
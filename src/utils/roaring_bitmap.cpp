@@ -0,0 +1,566 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/roaring_bitmap.h"
+#include <algorithm>
+UTILS_NAMESPACE_BEGIN
+
+typedef CRoaringBitmap::Container Container;
+
+static bool less_key(const Container& container, uint16_t key)
+{
+    return container.key < key;
+}
+
+static inline bool test_bit(const std::vector<uint64_t>& bitmap, uint16_t low)
+{
+    return (bitmap[low >> 6] >> (low & 63)) & 1;
+}
+
+static void to_bitmap_container(Container* container)
+{
+    container->bitmap.assign(CRoaringBitmap::BITMAP_WORDS, 0);
+    for (std::vector<uint16_t>::size_type i=0; i<container->array.size(); ++i)
+    {
+        const uint16_t low = container->array[i];
+        container->bitmap[low >> 6] |= UINT64_C(1) << (low & 63);
+    }
+    std::vector<uint16_t>().swap(container->array);
+}
+
+static void to_array_container(Container* container)
+{
+    container->array.clear();
+    container->array.reserve(container->cardinality);
+    for (int i=0; i<CRoaringBitmap::BITMAP_WORDS; ++i)
+    {
+        uint64_t word = container->bitmap[i];
+        while (word != 0)
+        {
+            container->array.push_back(static_cast<uint16_t>((i << 6) + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+    std::vector<uint64_t>().swap(container->bitmap);
+}
+
+// 按元素个数选择表示形式，个数相同的容器形式也相同，因此比较时可以直接比较内容
+static void normalize(Container* container)
+{
+    if (container->is_bitmap())
+    {
+        if (container->cardinality <= CRoaringBitmap::ARRAY_MAX_SIZE)
+            to_array_container(container);
+    }
+    else
+    {
+        container->cardinality = static_cast<uint32_t>(container->array.size());
+        if (container->cardinality > CRoaringBitmap::ARRAY_MAX_SIZE)
+            to_bitmap_container(container);
+    }
+}
+
+// 以数组a中在b中的元素替换a，b远大于a时二分查找，否则归并
+static void intersect_arrays(std::vector<uint16_t>* a, const std::vector<uint16_t>& b)
+{
+    std::vector<uint16_t>::size_type n = 0;
+    if (a->size() * 64 < b.size())
+    {
+        for (std::vector<uint16_t>::size_type i=0; i<a->size(); ++i)
+        {
+            if (std::binary_search(b.begin(), b.end(), (*a)[i]))
+                (*a)[n++] = (*a)[i];
+        }
+    }
+    else
+    {
+        std::vector<uint16_t>::size_type i = 0, j = 0;
+        while ((i < a->size()) && (j < b.size()))
+        {
+            if ((*a)[i] < b[j])
+                ++i;
+            else if (b[j] < (*a)[i])
+                ++j;
+            else
+                (*a)[n++] = (*a)[i++], ++j;
+        }
+    }
+    a->resize(n);
+}
+
+static uint32_t intersect_count_arrays(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b)
+{
+    const std::vector<uint16_t>& small = (a.size() < b.size())? a: b;
+    const std::vector<uint16_t>& large = (a.size() < b.size())? b: a;
+    uint32_t count = 0;
+
+    if (small.size() * 64 < large.size())
+    {
+        for (std::vector<uint16_t>::size_type i=0; i<small.size(); ++i)
+            count += std::binary_search(large.begin(), large.end(), small[i])? 1: 0;
+    }
+    else
+    {
+        // 无分支的归并，随机数据下比较结果难以预测，分支预测失败的开销大于多做的运算
+        std::vector<uint16_t>::size_type i = 0, j = 0;
+        while ((i < small.size()) && (j < large.size()))
+        {
+            const uint16_t x = small[i];
+            const uint16_t y = large[j];
+            count += (x == y);
+            i += (x <= y);
+            j += (y <= x);
+        }
+    }
+    return count;
+}
+
+static void intersect(Container* a, const Container& b)
+{
+    if (a->is_bitmap() && b.is_bitmap())
+    {
+        CBitmap::and_words(&a->bitmap[0], &b.bitmap[0], CRoaringBitmap::BITMAP_WORDS);
+        a->cardinality = static_cast<uint32_t>(CBitmap::count_words(&a->bitmap[0], CRoaringBitmap::BITMAP_WORDS));
+    }
+    else if (a->is_bitmap())
+    {
+        // 结果不多于b的元素个数，直接得到数组
+        Container result(a->key);
+        for (std::vector<uint16_t>::size_type i=0; i<b.array.size(); ++i)
+        {
+            if (test_bit(a->bitmap, b.array[i]))
+                result.array.push_back(b.array[i]);
+        }
+        result.cardinality = static_cast<uint32_t>(result.array.size());
+        std::swap(*a, result);
+    }
+    else if (b.is_bitmap())
+    {
+        std::vector<uint16_t>::size_type n = 0;
+        for (std::vector<uint16_t>::size_type i=0; i<a->array.size(); ++i)
+        {
+            if (test_bit(b.bitmap, a->array[i]))
+                a->array[n++] = a->array[i];
+        }
+        a->array.resize(n);
+    }
+    else
+    {
+        intersect_arrays(&a->array, b.array);
+    }
+    normalize(a);
+}
+
+static void unite(Container* a, const Container& b)
+{
+    if (!a->is_bitmap() && !b.is_bitmap())
+    {
+        std::vector<uint16_t> result;
+        result.reserve(a->array.size() + b.array.size());
+        std::set_union(a->array.begin(), a->array.end(), b.array.begin(), b.array.end(), std::back_inserter(result));
+        a->array.swap(result);
+    }
+    else
+    {
+        if (!a->is_bitmap())
+            to_bitmap_container(a);
+        if (b.is_bitmap())
+        {
+            CBitmap::or_words(&a->bitmap[0], &b.bitmap[0], CRoaringBitmap::BITMAP_WORDS);
+        }
+        else
+        {
+            for (std::vector<uint16_t>::size_type i=0; i<b.array.size(); ++i)
+                a->bitmap[b.array[i] >> 6] |= UINT64_C(1) << (b.array[i] & 63);
+        }
+        a->cardinality = static_cast<uint32_t>(CBitmap::count_words(&a->bitmap[0], CRoaringBitmap::BITMAP_WORDS));
+    }
+    normalize(a);
+}
+
+static void subtract(Container* a, const Container& b)
+{
+    if (a->is_bitmap())
+    {
+        if (b.is_bitmap())
+        {
+            CBitmap::and_not_words(&a->bitmap[0], &b.bitmap[0], CRoaringBitmap::BITMAP_WORDS);
+        }
+        else
+        {
+            for (std::vector<uint16_t>::size_type i=0; i<b.array.size(); ++i)
+                a->bitmap[b.array[i] >> 6] &= ~(UINT64_C(1) << (b.array[i] & 63));
+        }
+        a->cardinality = static_cast<uint32_t>(CBitmap::count_words(&a->bitmap[0], CRoaringBitmap::BITMAP_WORDS));
+    }
+    else if (b.is_bitmap())
+    {
+        std::vector<uint16_t>::size_type n = 0;
+        for (std::vector<uint16_t>::size_type i=0; i<a->array.size(); ++i)
+        {
+            if (!test_bit(b.bitmap, a->array[i]))
+                a->array[n++] = a->array[i];
+        }
+        a->array.resize(n);
+    }
+    else
+    {
+        std::vector<uint16_t> result;
+        result.reserve(a->array.size());
+        std::set_difference(a->array.begin(), a->array.end(), b.array.begin(), b.array.end(), std::back_inserter(result));
+        a->array.swap(result);
+    }
+    normalize(a);
+}
+
+static uint32_t intersect_count(const Container& a, const Container& b)
+{
+    if (a.is_bitmap() && b.is_bitmap())
+        return static_cast<uint32_t>(CBitmap::and_count_words(&a.bitmap[0], &b.bitmap[0], CRoaringBitmap::BITMAP_WORDS));
+    if (a.is_bitmap() || b.is_bitmap())
+    {
+        const Container& array = a.is_bitmap()? b: a;
+        const Container& bitmap = a.is_bitmap()? a: b;
+        uint32_t count = 0;
+        for (std::vector<uint16_t>::size_type i=0; i<array.array.size(); ++i)
+            count += test_bit(bitmap.bitmap, array.array[i])? 1: 0;
+        return count;
+    }
+    return intersect_count_arrays(a.array, b.array);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool CRoaringBitmap::add(uint32_t value)
+{
+    Container* container = get_container(static_cast<uint16_t>(value >> 16));
+    const uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+
+    if (container->is_bitmap())
+    {
+        uint64_t& word = container->bitmap[low >> 6];
+        const uint64_t mask = UINT64_C(1) << (low & 63);
+        if ((word & mask) != 0)
+            return false;
+        word |= mask;
+        ++container->cardinality;
+    }
+    else
+    {
+        std::vector<uint16_t>::iterator iter = std::lower_bound(container->array.begin(), container->array.end(), low);
+        if ((iter != container->array.end()) && (*iter == low))
+            return false;
+        container->array.insert(iter, low);
+        normalize(container);
+    }
+
+    return true;
+}
+
+void CRoaringBitmap::add_range(uint32_t begin, uint64_t end)
+{
+    if (end > (UINT64_C(1) << 32))
+        end = UINT64_C(1) << 32;
+
+    for (uint64_t start=begin; start<end; )
+    {
+        const uint64_t stop = std::min(end, (start | 0xFFFF) + 1); // 不超出当前容器
+        Container* container = get_container(static_cast<uint16_t>(start >> 16));
+        const uint32_t low = static_cast<uint32_t>(start & 0xFFFF);
+        const uint32_t high = static_cast<uint32_t>(stop - (start & ~UINT64_C(0xFFFF))); // 不含
+
+        if (!container->is_bitmap())
+            to_bitmap_container(container);
+        for (uint32_t i=low; i<high; )
+        {
+            // 整字的一次设置
+            if ((0 == (i & 63)) && (i + 64 <= high))
+            {
+                container->bitmap[i >> 6] = ~UINT64_C(0);
+                i += 64;
+            }
+            else
+            {
+                container->bitmap[i >> 6] |= UINT64_C(1) << (i & 63);
+                ++i;
+            }
+        }
+        container->cardinality = static_cast<uint32_t>(CBitmap::count_words(&container->bitmap[0], BITMAP_WORDS));
+        normalize(container);
+        start = stop;
+    }
+}
+
+bool CRoaringBitmap::remove(uint32_t value)
+{
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+    Container* container = find_container(key);
+    if (NULL == container)
+        return false;
+
+    if (container->is_bitmap())
+    {
+        uint64_t& word = container->bitmap[low >> 6];
+        const uint64_t mask = UINT64_C(1) << (low & 63);
+        if (0 == (word & mask))
+            return false;
+        word &= ~mask;
+        --container->cardinality;
+    }
+    else
+    {
+        std::vector<uint16_t>::iterator iter = std::lower_bound(container->array.begin(), container->array.end(), low);
+        if ((iter == container->array.end()) || (*iter != low))
+            return false;
+        container->array.erase(iter);
+    }
+
+    normalize(container);
+    if (0 == container->cardinality)
+        _containers.erase(_containers.begin() + (container - &_containers[0]));
+    return true;
+}
+
+bool CRoaringBitmap::contains(uint32_t value) const
+{
+    const Container* container = find_container(static_cast<uint16_t>(value >> 16));
+    const uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+    if (NULL == container)
+        return false;
+    if (container->is_bitmap())
+        return test_bit(container->bitmap, low);
+    return std::binary_search(container->array.begin(), container->array.end(), low);
+}
+
+uint64_t CRoaringBitmap::size() const
+{
+    uint64_t number = 0;
+    for (std::vector<Container>::size_type i=0; i<_containers.size(); ++i)
+        number += _containers[i].cardinality;
+    return number;
+}
+
+CRoaringBitmap& CRoaringBitmap::operator &=(const CRoaringBitmap& other)
+{
+    std::vector<Container>::size_type n = 0;
+    std::vector<Container>::size_type i = 0, j = 0;
+
+    while ((i < _containers.size()) && (j < other._containers.size()))
+    {
+        if (_containers[i].key < other._containers[j].key)
+        {
+            ++i;
+        }
+        else if (other._containers[j].key < _containers[i].key)
+        {
+            ++j;
+        }
+        else
+        {
+            intersect(&_containers[i], other._containers[j]);
+            if (_containers[i].cardinality > 0)
+            {
+                if (n != i)
+                    std::swap(_containers[n], _containers[i]);
+                ++n;
+            }
+            ++i, ++j;
+        }
+    }
+
+    _containers.resize(n);
+    return *this;
+}
+
+CRoaringBitmap& CRoaringBitmap::operator |=(const CRoaringBitmap& other)
+{
+    std::vector<Container> result;
+    std::vector<Container>::size_type i = 0, j = 0;
+
+    result.reserve(_containers.size() + other._containers.size());
+    while ((i < _containers.size()) || (j < other._containers.size()))
+    {
+        if ((j == other._containers.size()) || ((i < _containers.size()) && (_containers[i].key < other._containers[j].key)))
+        {
+            result.push_back(Container());
+            std::swap(result.back(), _containers[i++]);
+        }
+        else if ((i == _containers.size()) || (other._containers[j].key < _containers[i].key))
+        {
+            result.push_back(other._containers[j++]);
+        }
+        else
+        {
+            unite(&_containers[i], other._containers[j]);
+            result.push_back(Container());
+            std::swap(result.back(), _containers[i]);
+            ++i, ++j;
+        }
+    }
+
+    _containers.swap(result);
+    return *this;
+}
+
+CRoaringBitmap& CRoaringBitmap::and_not(const CRoaringBitmap& other)
+{
+    std::vector<Container>::size_type n = 0;
+    std::vector<Container>::size_type j = 0;
+
+    for (std::vector<Container>::size_type i=0; i<_containers.size(); ++i)
+    {
+        while ((j < other._containers.size()) && (other._containers[j].key < _containers[i].key))
+            ++j;
+        if ((j < other._containers.size()) && (other._containers[j].key == _containers[i].key))
+            subtract(&_containers[i], other._containers[j]);
+        if (_containers[i].cardinality > 0)
+        {
+            if (n != i)
+                std::swap(_containers[n], _containers[i]);
+            ++n;
+        }
+    }
+
+    _containers.resize(n);
+    return *this;
+}
+
+uint64_t CRoaringBitmap::and_count(const CRoaringBitmap& other) const
+{
+    uint64_t count = 0;
+    std::vector<Container>::size_type i = 0, j = 0;
+
+    while ((i < _containers.size()) && (j < other._containers.size()))
+    {
+        if (_containers[i].key < other._containers[j].key)
+            ++i;
+        else if (other._containers[j].key < _containers[i].key)
+            ++j;
+        else
+            count += intersect_count(_containers[i++], other._containers[j++]);
+    }
+    return count;
+}
+
+bool CRoaringBitmap::operator ==(const CRoaringBitmap& other) const
+{
+    if (_containers.size() != other._containers.size())
+        return false;
+
+    for (std::vector<Container>::size_type i=0; i<_containers.size(); ++i)
+    {
+        const Container& a = _containers[i];
+        const Container& b = other._containers[i];
+        if ((a.key != b.key) || (a.cardinality != b.cardinality) || (a.array != b.array) || (a.bitmap != b.bitmap))
+            return false;
+    }
+    return true;
+}
+
+void CRoaringBitmap::to_vector(std::vector<uint32_t>* values) const
+{
+    values->clear();
+    values->reserve(static_cast<std::vector<uint32_t>::size_type>(size()));
+    for (std::vector<Container>::size_type i=0; i<_containers.size(); ++i)
+    {
+        const Container& container = _containers[i];
+        const uint32_t high = static_cast<uint32_t>(container.key) << 16;
+        if (container.is_bitmap())
+        {
+            for (int j=0; j<BITMAP_WORDS; ++j)
+            {
+                uint64_t word = container.bitmap[j];
+                while (word != 0)
+                {
+                    values->push_back(high | static_cast<uint32_t>((j << 6) + __builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+        }
+        else
+        {
+            for (std::vector<uint16_t>::size_type j=0; j<container.array.size(); ++j)
+                values->push_back(high | container.array[j]);
+        }
+    }
+}
+
+void CRoaringBitmap::to_bitmap(CBitmap* bitmap) const
+{
+    const size_t bit_number = bitmap->size();
+    bitmap->reset_all();
+    for (std::vector<Container>::size_type i=0; i<_containers.size(); ++i)
+    {
+        const Container& container = _containers[i];
+        const size_t high = static_cast<size_t>(container.key) << 16;
+        if (high >= bit_number)
+            break;
+
+        if (container.is_bitmap() && (high + 65536 <= bit_number))
+        {
+            // 容器的起点是64的倍数，整块复制
+            std::copy(container.bitmap.begin(), container.bitmap.end(), bitmap->words() + (high >> 6));
+        }
+        else if (container.is_bitmap())
+        {
+            for (size_t j=0; high+j<bit_number; ++j)
+            {
+                if (test_bit(container.bitmap, static_cast<uint16_t>(j)))
+                    bitmap->set(high + j);
+            }
+        }
+        else
+        {
+            for (std::vector<uint16_t>::size_type j=0; j<container.array.size(); ++j)
+            {
+                if (high + container.array[j] < bit_number)
+                    bitmap->set(high + container.array[j]);
+            }
+        }
+    }
+}
+
+size_t CRoaringBitmap::get_memory_size() const
+{
+    size_t memory_size = _containers.size() * sizeof(Container);
+    for (std::vector<Container>::size_type i=0; i<_containers.size(); ++i)
+        memory_size += _containers[i].array.size() * sizeof(uint16_t) + _containers[i].bitmap.size() * sizeof(uint64_t);
+    return memory_size;
+}
+
+CRoaringBitmap::Container* CRoaringBitmap::find_container(uint16_t key)
+{
+    std::vector<Container>::iterator iter = std::lower_bound(_containers.begin(), _containers.end(), key, less_key);
+    return ((iter == _containers.end()) || (iter->key != key))? NULL: &*iter;
+}
+
+const CRoaringBitmap::Container* CRoaringBitmap::find_container(uint16_t key) const
+{
+    std::vector<Container>::const_iterator iter = std::lower_bound(_containers.begin(), _containers.end(), key, less_key);
+    return ((iter == _containers.end()) || (iter->key != key))? NULL: &*iter;
+}
+
+CRoaringBitmap::Container* CRoaringBitmap::get_container(uint16_t key)
+{
+    std::vector<Container>::iterator iter = std::lower_bound(_containers.begin(), _containers.end(), key, less_key);
+    if ((iter == _containers.end()) || (iter->key != key))
+        iter = _containers.insert(iter, Container(key));
+    return &*iter;
+}
+
+UTILS_NAMESPACE_END
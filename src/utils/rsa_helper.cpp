@@ -23,281 +23,218 @@
 #include <openssl/err.h>
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
+#include <map>
+#include <pthread.h>
+#include <sys/stat.h>
 UTILS_NAMESPACE_BEGIN
 
-// 生成密钥文件（包含公钥和私钥两部分）：
-// openssl genrsa -out abc.key 1024
-//
-// 提取公钥：
-// openssl rsa -in abc.key -pubout -out pub.key
-//
-// 用公钥加密文件：
-// openssl rsautl -encrypt -in test.txt -inkey pub.key -pubin -out test.dat
-//
-// 用私钥解密文件：
-// openssl rsautl -decrypt -in test.dat -inkey abc.key -out test.txt
+////////////////////////////////////////////////////////////////////////////////
+// 缓存的键为：'F'或'K'（文件或PEM内容） + '1'或'0'（私钥或公钥） + 文件名或PEM内容
+struct CachedKey
+{
+    RSA* rsa;
+    time_t mtime;
+    long mtime_nsec;
+};
 
-// 参考：
-// http://hayageek.com/rsa-encryption-decryption-openssl-c/
-void CRSAHelper::public_encrypt_bykeyfile(const std::string& pub_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+static pthread_mutex_t key_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, CachedKey> key_cache;
+static const std::map<std::string, CachedKey>::size_type key_cache_size_max = 64;
+
+class CKeyCacheLock
 {
-    int errcode = 0;
-    RSA* rsa = NULL;
-    FILE* fp = fopen(pub_keyfile.c_str(), "r");
+public:
+    CKeyCacheLock() { pthread_mutex_lock(&key_cache_mutex); }
+    ~CKeyCacheLock() { pthread_mutex_unlock(&key_cache_mutex); }
+};
 
-    if (fp == NULL)
-    {
-        errcode = errno;
-        THROW_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", pub_keyfile.c_str(), strerror(errcode)), errcode);
-    }
-    rsa = PEM_read_RSA_PUBKEY(fp, NULL, NULL, NULL);
-    if (rsa == NULL)
-    {
-        errcode = ERR_get_error();
-        utils::ScopedArray<char> buf(new char[SIZE_4K]);
-        ERR_error_string_n(errcode, buf.get(), SIZE_4K);
-        fclose(fp);
-        THROW_EXCEPTION(utils::CStringUtils::format_string("read %s failed: %s", pub_keyfile.c_str(), buf.get()), errcode);
-    }
+// 结束时释放RSA
+class CRSAFreeHelper
+{
+public:
+    CRSAFreeHelper(RSA* rsa): _rsa(rsa) {}
+    ~CRSAFreeHelper() { RSA_free(_rsa); }
 
-    try
-    {
-        public_encrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        fclose(fp);
-    }
-    catch (...)
-    {
-        RSA_free(rsa);
-        fclose(fp);
-        throw;
-    }
-}
+private:
+    RSA* _rsa;
+};
 
-void CRSAHelper::private_decrypt_bykeyfile(const std::string& priv_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+static RSA* read_key(const std::string& key_or_keyfile, bool is_private, bool is_file)
 {
     int errcode = 0;
     RSA* rsa = NULL;
-    FILE* fp = fopen(priv_keyfile.c_str(), "r");
 
-    if (fp == NULL)
-    {
-        errcode = errno;
-        THROW_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", priv_keyfile.c_str(), strerror(errcode)), errcode);
-    }
-    rsa = PEM_read_RSAPrivateKey(fp, NULL, NULL, NULL);
-    if (rsa == NULL)
+    if (is_file)
     {
-        errcode = ERR_get_error();
-        utils::ScopedArray<char> buf(new char[SIZE_4K]);
-        ERR_error_string_n(errcode, buf.get(), SIZE_4K);
-        fclose(fp);
-        THROW_EXCEPTION(utils::CStringUtils::format_string("read %s failed: %s", priv_keyfile.c_str(), buf.get()), errcode);
-    }
+        FILE* fp = fopen(key_or_keyfile.c_str(), "r");
+        if (fp == NULL)
+        {
+            errcode = errno;
+            THROW_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", key_or_keyfile.c_str(), strerror(errcode)), errcode);
+        }
 
-    try
-    {
-        private_decrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
+        rsa = is_private? PEM_read_RSAPrivateKey(fp, NULL, NULL, NULL): PEM_read_RSA_PUBKEY(fp, NULL, NULL, NULL);
         fclose(fp);
     }
-    catch (...)
+    else
     {
-        RSA_free(rsa);
-        fclose(fp);
-        throw;
+        // BIO_s_mem() return the memory BIO method function.
+        // A memory BIO is a source/sink BIO which uses memory for its I/O.
+        //
+        // https://linux.die.net/man/3/bio_new_mem_buf
+        BIO* keybio = BIO_new_mem_buf((void*)key_or_keyfile.data(), static_cast<int>(key_or_keyfile.size()));
+        if (keybio == NULL)
+        {
+            errcode = ERR_get_error();
+            THROW_EXCEPTION("failed to create key BIO", errcode);
+        }
+
+        rsa = is_private? PEM_read_bio_RSAPrivateKey(keybio, NULL, NULL, NULL): PEM_read_bio_RSA_PUBKEY(keybio, NULL, NULL, NULL);
+        BIO_free(keybio);
     }
-}
-
-void CRSAHelper::private_encrypt_bykeyfile(const std::string& priv_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
-{
-    int errcode = 0;
-    RSA* rsa = NULL;
-    FILE* fp = fopen(priv_keyfile.c_str(), "r");
 
-    if (fp == NULL)
-    {
-        errcode = errno;
-        THROW_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", priv_keyfile.c_str(), strerror(errcode)), errcode);
-    }
-    rsa = PEM_read_RSAPrivateKey(fp, NULL, NULL, NULL);
     if (rsa == NULL)
     {
         errcode = ERR_get_error();
         utils::ScopedArray<char> buf(new char[SIZE_4K]);
         ERR_error_string_n(errcode, buf.get(), SIZE_4K);
-        fclose(fp);
-        THROW_EXCEPTION(utils::CStringUtils::format_string("read %s failed: %s", priv_keyfile.c_str(), buf.get()), errcode);
+        THROW_EXCEPTION(utils::CStringUtils::format_string("read %s failed: %s", is_file? key_or_keyfile.c_str(): "key", buf.get()), errcode);
     }
 
-    try
-    {
-        private_encrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        fclose(fp);
-    }
-    catch (...)
-    {
-        RSA_free(rsa);
-        fclose(fp);
-        throw;
-    }
+    return rsa;
 }
 
-void CRSAHelper::public_decrypt_bykeyfile(const std::string& pub_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+void* CRSAHelper::get_cached_key(const std::string& key_or_keyfile, bool is_private, bool is_file)
 {
-    int errcode = 0;
-    RSA* rsa = NULL;
-    FILE* fp = fopen(pub_keyfile.c_str(), "r");
+    std::string cache_key;
+    cache_key.reserve(key_or_keyfile.size() + 2);
+    cache_key.push_back(is_file? 'F': 'K');
+    cache_key.push_back(is_private? '1': '0');
+    cache_key.append(key_or_keyfile);
 
-    if (fp == NULL)
+    // 文件修改后（如更换密钥）重新解析
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if (is_file && (-1 == stat(key_or_keyfile.c_str(), &st)))
     {
-        errcode = errno;
-        THROW_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", pub_keyfile.c_str(), strerror(errcode)), errcode);
+        const int errcode = errno;
+        THROW_EXCEPTION(utils::CStringUtils::format_string("open %s failed: %s", key_or_keyfile.c_str(), strerror(errcode)), errcode);
     }
-    rsa = PEM_read_RSA_PUBKEY(fp, NULL, NULL, NULL);
-    if (rsa == NULL)
+
     {
-        errcode = ERR_get_error();
-        utils::ScopedArray<char> buf(new char[SIZE_4K]);
-        ERR_error_string_n(errcode, buf.get(), SIZE_4K);
-        fclose(fp);
-        THROW_EXCEPTION(utils::CStringUtils::format_string("read %s failed: %s", pub_keyfile.c_str(), buf.get()), errcode);
+        CKeyCacheLock lock;
+        std::map<std::string, CachedKey>::iterator iter = key_cache.find(cache_key);
+        if ((iter != key_cache.end()) && (iter->second.mtime == st.st_mtim.tv_sec) && (iter->second.mtime_nsec == st.st_mtim.tv_nsec))
+        {
+            RSA_up_ref(iter->second.rsa);
+            return iter->second.rsa;
+        }
     }
 
-    try
+    // 解析不持锁，多个线程同时解析同一个密钥时以最后一个为准
+    RSA* rsa = read_key(key_or_keyfile, is_private, is_file);
+    CachedKey cached_key = { rsa, st.st_mtim.tv_sec, st.st_mtim.tv_nsec };
+    CKeyCacheLock lock;
+
+    std::map<std::string, CachedKey>::iterator iter = key_cache.find(cache_key);
+    if (iter != key_cache.end())
     {
-        public_decrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        fclose(fp);
+        RSA_free(iter->second.rsa);
+        iter->second = cached_key;
     }
-    catch (...)
+    else
     {
-        RSA_free(rsa);
-        fclose(fp);
-        throw;
+        if (key_cache.size() >= key_cache_size_max)
+        {
+            for (iter=key_cache.begin(); iter!=key_cache.end(); ++iter)
+                RSA_free(iter->second.rsa);
+            key_cache.clear();
+        }
+        key_cache.insert(std::make_pair(cache_key, cached_key));
     }
+
+    RSA_up_ref(rsa);
+    return rsa;
 }
 
-void CRSAHelper::public_encrypt_bykey(const std::string& pub_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+// 加密时明文的长度不能超过RSA_size减去填充的开销，NO_PADDING时必须等于RSA_size
+static void check_input_size(const std::string& instr, int size_max, RSAPaddingMode mode)
 {
-    int errcode = 0;
-    BIO* keybio = NULL;
-    RSA* rsa = NULL;
+    if ((static_cast<int>(instr.size()) > size_max) || ((NO_PADDING == mode) && (static_cast<int>(instr.size()) != size_max)))
+        THROW_EXCEPTION(utils::CStringUtils::format_string("invalid input size: %zu (max: %d)", instr.size(), size_max), -2);
+}
 
-    // BIO_s_mem() return the memory BIO method function.
-    // A memory BIO is a source/sink BIO which uses memory for its I/O.
-    // Data written to a memory BIO is stored in a BUF_MEM structure which is
-    // extended as appropriate to accommodate the stored data.
-    //
-    // https://linux.die.net/man/3/bio_new_mem_buf
-    keybio = BIO_new_mem_buf((void*)pub_key.c_str(), -1);
-    if (keybio == NULL)
-    {
-        errcode = ERR_get_error();
-        THROW_EXCEPTION("failed to create key BIO", errcode);
-    }
+// 生成密钥文件（包含公钥和私钥两部分）：
+// openssl genrsa -out abc.key 1024
+//
+// 提取公钥：
+// openssl rsa -in abc.key -pubout -out pub.key
+//
+// 用公钥加密文件：
+// openssl rsautl -encrypt -in test.txt -inkey pub.key -pubin -out test.dat
+//
+// 用私钥解密文件：
+// openssl rsautl -decrypt -in test.dat -inkey abc.key -out test.txt
 
-    try
-    {
-        PEM_read_bio_RSA_PUBKEY(keybio, &rsa, NULL, NULL);
-        public_encrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        BIO_free(keybio);
-    }
-    catch (...)
-    {
-        RSA_free(rsa);
-        BIO_free(keybio);
-        throw;
-    }
+// 参考：
+// http://hayageek.com/rsa-encryption-decryption-openssl-c/
+void CRSAHelper::public_encrypt_bykeyfile(const std::string& pub_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+{
+    RSA* rsa = (RSA*)get_cached_key(pub_keyfile, false, true);
+    CRSAFreeHelper free_helper(rsa);
+    public_encrypt(rsa, instr, outstr, mode);
 }
 
-void CRSAHelper::private_decrypt_bykey(const std::string& priv_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+void CRSAHelper::private_decrypt_bykeyfile(const std::string& priv_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
 {
-    int errcode = 0;
-    BIO* keybio = NULL;
-    RSA* rsa = NULL;
+    RSA* rsa = (RSA*)get_cached_key(priv_keyfile, true, true);
+    CRSAFreeHelper free_helper(rsa);
+    private_decrypt(rsa, instr, outstr, mode);
+}
 
-    keybio = BIO_new_mem_buf((void*)priv_key.c_str(), -1);
-    if (keybio == NULL)
-    {
-        errcode = ERR_get_error();
-        THROW_EXCEPTION("failed to create key BIO", errcode);
-    }
+void CRSAHelper::private_encrypt_bykeyfile(const std::string& priv_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+{
+    RSA* rsa = (RSA*)get_cached_key(priv_keyfile, true, true);
+    CRSAFreeHelper free_helper(rsa);
+    private_encrypt(rsa, instr, outstr, mode);
+}
 
-    try
-    {
-        PEM_read_bio_RSAPrivateKey(keybio, &rsa, NULL, NULL);
-        private_decrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        BIO_free(keybio);
-    }
-    catch (...)
-    {
-        RSA_free(rsa);
-        BIO_free(keybio);
-        throw;
-    }
+void CRSAHelper::public_decrypt_bykeyfile(const std::string& pub_keyfile, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+{
+    RSA* rsa = (RSA*)get_cached_key(pub_keyfile, false, true);
+    CRSAFreeHelper free_helper(rsa);
+    public_decrypt(rsa, instr, outstr, mode);
 }
 
-void CRSAHelper::private_encrypt_bykey(const std::string& priv_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+void CRSAHelper::public_encrypt_bykey(const std::string& pub_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
 {
-    int errcode = 0;
-    BIO* keybio = NULL;
-    RSA* rsa = NULL;
+    RSA* rsa = (RSA*)get_cached_key(pub_key, false, false);
+    CRSAFreeHelper free_helper(rsa);
+    public_encrypt(rsa, instr, outstr, mode);
+}
 
-    keybio = BIO_new_mem_buf((void*)priv_key.c_str(), -1);
-    if (keybio == NULL)
-    {
-        errcode = ERR_get_error();
-        THROW_EXCEPTION("failed to create key BIO", errcode);
-    }
+void CRSAHelper::private_decrypt_bykey(const std::string& priv_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+{
+    RSA* rsa = (RSA*)get_cached_key(priv_key, true, false);
+    CRSAFreeHelper free_helper(rsa);
+    private_decrypt(rsa, instr, outstr, mode);
+}
 
-    try
-    {
-        PEM_read_bio_RSAPrivateKey(keybio, &rsa, NULL, NULL);
-        private_encrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        BIO_free(keybio);
-    }
-    catch (...)
-    {
-        RSA_free(rsa);
-        BIO_free(keybio);
-        throw;
-    }
+void CRSAHelper::private_encrypt_bykey(const std::string& priv_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+{
+    RSA* rsa = (RSA*)get_cached_key(priv_key, true, false);
+    CRSAFreeHelper free_helper(rsa);
+    private_encrypt(rsa, instr, outstr, mode);
 }
 
 void CRSAHelper::public_decrypt_bykey(const std::string& pub_key, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
 {
-    int errcode = 0;
-    BIO* keybio = NULL;
-    RSA* rsa = NULL;
-
-    keybio = BIO_new_mem_buf((void*)pub_key.c_str(), -1);
-    if (keybio == NULL)
-    {
-        errcode = ERR_get_error();
-        THROW_EXCEPTION("failed to create key BIO", errcode);
-    }
-
-    try
-    {
-        PEM_read_bio_RSA_PUBKEY(keybio, &rsa, NULL, NULL);
-        public_decrypt(rsa, instr, outstr, mode);
-        RSA_free(rsa);
-        BIO_free(keybio);
-    }
-    catch (...)
-    {
-        RSA_free(rsa);
-        BIO_free(keybio);
-        throw;
-    }
+    RSA* rsa = (RSA*)get_cached_key(pub_key, false, false);
+    CRSAFreeHelper free_helper(rsa);
+    public_decrypt(rsa, instr, outstr, mode);
 }
 
-void CRSAHelper::CRSAHelper::public_encrypt(void* rsa, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
+void CRSAHelper::public_encrypt(void* rsa, const std::string& instr, std::string* outstr, RSAPaddingMode mode)
 {
     int errcode = 0;
     int rsalen = 0;
@@ -314,6 +251,7 @@ void CRSAHelper::CRSAHelper::public_encrypt(void* rsa, const std::string& instr,
         rsalen = rsalen - 11;
     else if (mode == PKCS1_OAEP_PADDING)
         rsalen = rsalen - 41;
+    check_input_size(instr, rsalen, mode);
 
     // RSA_public_encrypt() encrypts the flen bytes at
     // from (usually a session key) using the public key rsa and stores the ciphertext in to.
@@ -329,7 +267,7 @@ void CRSAHelper::CRSAHelper::public_encrypt(void* rsa, const std::string& instr,
     // https://linux.die.net/man/3/rsa_public_encrypt
     //
     // int RSA_public_encrypt(int flen, unsigned char *from, unsigned char *to, RSA *rsa, int padding);
-    outlen = RSA_public_encrypt(rsalen, (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
+    outlen = RSA_public_encrypt(static_cast<int>(instr.size()), (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
     if (outlen != -1)
     {
         // SUCCESS
@@ -357,10 +295,6 @@ void CRSAHelper::private_decrypt(void* rsa, const std::string& instr, std::strin
     // RSA_size() is available in all versions of SSLeay and OpenSSL.
     rsalen = RSA_size(rsa_);
     outstr->resize(rsalen);
-    if (mode == PKCS1_PADDING)
-        rsalen = rsalen - 11;
-    else if (mode == PKCS1_OAEP_PADDING)
-        rsalen = rsalen - 41;
 
     // RSA_private_decrypt() decrypts the flen bytes at from using the private key rsa and stores the plaintext in to.
     // to must point to a memory section large enough to hold the decrypted data (which is smaller than RSA_size(rsa)).
@@ -368,7 +302,7 @@ void CRSAHelper::private_decrypt(void* rsa, const std::string& instr, std::strin
     //
     // RSA_private_decrypt() returns the size of the recovered plaintext.
     // On error, -1 is returned; the error codes can be obtained by err_get_error(3).
-    outlen = RSA_private_decrypt(rsalen, (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
+    outlen = RSA_private_decrypt(static_cast<int>(instr.size()), (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
     if (outlen != -1)
     {
         // SUCCESS
@@ -400,6 +334,7 @@ void CRSAHelper::private_encrypt(void* rsa, const std::string& instr, std::strin
         rsalen = rsalen - 11;
     else if (mode == PKCS1_OAEP_PADDING)
         rsalen = rsalen - 41;
+    check_input_size(instr, rsalen, mode);
 
     // RSA_private_encrypt() signs the flen bytes at from (usually a message digest with an algorithm identifier)
     // using the private key rsa and stores the signature in to.
@@ -407,7 +342,7 @@ void CRSAHelper::private_encrypt(void* rsa, const std::string& instr, std::strin
     //
     // RSA_private_encrypt() returns the size of the signature (i.e., RSA_size(rsa)).
     // On error, -1 is returned; the error codes can be obtained by err_get_error(3).
-    outlen = RSA_private_encrypt(rsalen, (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
+    outlen = RSA_private_encrypt(static_cast<int>(instr.size()), (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
     if (outlen != -1)
     {
         outstr->resize(outlen);
@@ -434,10 +369,6 @@ void CRSAHelper::public_decrypt(void* rsa, const std::string& instr, std::string
     // RSA_size() is available in all versions of SSLeay and OpenSSL.
     rsalen = RSA_size(rsa_);
     outstr->resize(rsalen);
-    if (mode == PKCS1_PADDING) // RSA_PKCS1_PADDING
-        rsalen = rsalen - 11;
-    else if (mode == PKCS1_OAEP_PADDING) // RSA_PKCS1_OAEP_PADDING
-        rsalen = rsalen - 41;
 
     // RSA_public_decrypt() recovers the message digest from the flen bytes long signature at
     // from using the signer's public key rsa. to must point to a memory section large enough to
@@ -446,7 +377,7 @@ void CRSAHelper::public_decrypt(void* rsa, const std::string& instr, std::string
     //
     // RSA_public_decrypt() returns the size of the recovered message digest.
     // On error, -1 is returned; the error codes can be obtained by err_get_error(3).
-    outlen = RSA_public_decrypt(rsalen, (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
+    outlen = RSA_public_decrypt(static_cast<int>(instr.size()), (unsigned char *)instr.data(), (unsigned char*)outstr->data(), rsa_, mode);
     if (outlen != -1)
     {
         outstr->resize(outlen);
@@ -460,6 +391,97 @@ void CRSAHelper::public_decrypt(void* rsa, const std::string& instr, std::string
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+CRSAKey::CRSAKey()
+    : _rsa(NULL), _is_private(false)
+{
+}
+
+CRSAKey::~CRSAKey()
+{
+    reset(NULL, false);
+}
+
+void CRSAKey::reset(void* rsa, bool is_private)
+{
+    if (_rsa != NULL)
+        RSA_free((RSA*)_rsa);
+    _rsa = rsa;
+    _is_private = is_private;
+}
+
+void CRSAKey::check_loaded() const
+{
+    if (NULL == _rsa)
+        THROW_EXCEPTION("key not loaded", -1);
+}
+
+void CRSAKey::load_public_key(const std::string& pub_key)
+{
+    reset(read_key(pub_key, false, false), false);
+}
+
+void CRSAKey::load_private_key(const std::string& priv_key)
+{
+    reset(read_key(priv_key, true, false), true);
+}
+
+void CRSAKey::load_public_keyfile(const std::string& pub_keyfile)
+{
+    reset(read_key(pub_keyfile, false, true), false);
+}
+
+void CRSAKey::load_private_keyfile(const std::string& priv_keyfile)
+{
+    reset(read_key(priv_keyfile, true, true), true);
+}
+
+int CRSAKey::size() const
+{
+    check_loaded();
+    return RSA_size((RSA*)_rsa);
+}
+
+void CRSAKey::public_encrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const
+{
+    check_loaded();
+    CRSAHelper::public_encrypt(_rsa, instr, outstr, mode);
+}
+
+void CRSAKey::private_decrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const
+{
+    check_loaded();
+    CRSAHelper::private_decrypt(_rsa, instr, outstr, mode);
+}
+
+void CRSAKey::private_encrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const
+{
+    check_loaded();
+    CRSAHelper::private_encrypt(_rsa, instr, outstr, mode);
+}
+
+void CRSAKey::public_decrypt(const std::string& instr, std::string* outstr, RSAPaddingMode mode) const
+{
+    check_loaded();
+    CRSAHelper::public_decrypt(_rsa, instr, outstr, mode);
+}
+
+void CRSAKey::public_encrypt(const std::vector<std::string>& instrs, std::vector<std::string>* outstrs, RSAPaddingMode mode) const
+{
+    check_loaded();
+    outstrs->resize(instrs.size());
+    for (std::vector<std::string>::size_type i=0; i<instrs.size(); ++i)
+        CRSAHelper::public_encrypt(_rsa, instrs[i], &(*outstrs)[i], mode);
+}
+
+void CRSAKey::private_decrypt(const std::vector<std::string>& instrs, std::vector<std::string>* outstrs, RSAPaddingMode mode) const
+{
+    check_loaded();
+    outstrs->resize(instrs.size());
+    for (std::vector<std::string>::size_type i=0; i<instrs.size(); ++i)
+        CRSAHelper::private_decrypt(_rsa, instrs[i], &(*outstrs)[i], mode);
+}
+
 UTILS_NAMESPACE_END
 #endif // MOOON_HAVE_OPENSSL
 
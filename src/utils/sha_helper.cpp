@@ -247,6 +247,12 @@ void CSHAHelper::update(const std::string& str)
 	update(str.c_str(), str.size());
 }
 
+void CSHAHelper::update(const struct iovec* iov, int iovcnt)
+{
+    for (int i=0; i<iovcnt; ++i)
+        update(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+}
+
 // Why does OPENSSL_cleanse look so complex and thread-unsafe?
 //
 // unsigned char cleanse_ctr = 0;
@@ -0,0 +1,341 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/sketch.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+UTILS_NAMESPACE_BEGIN
+
+CSketchStorage::CSketchStorage(sketch_type_t type)
+    : _data(NULL), _data_size(0), _type(type), _attached(false)
+{
+    memset(_params, 0, sizeof(_params));
+}
+
+CSketchStorage::~CSketchStorage()
+{
+    release();
+}
+
+void CSketchStorage::serialize(void* buffer) const
+{
+    sketch_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SKETCH_MAGIC;
+    header.type = static_cast<uint16_t>(_type);
+    header.version = SKETCH_VERSION;
+    header.data_size = _data_size;
+    memcpy(header.params, _params, sizeof(header.params));
+
+    memcpy(buffer, &header, sizeof(header));
+    if (_data_size > 0)
+        memcpy(static_cast<char*>(buffer) + sizeof(header), _data, _data_size);
+}
+
+std::string CSketchStorage::serialize() const
+{
+    std::string str(get_serialized_size(), '\0');
+    serialize(&str[0]);
+    return str;
+}
+
+bool CSketchStorage::attach(void* buffer, size_t size)
+{
+    sketch_header_t header;
+    if ((0 != (reinterpret_cast<uintptr_t>(buffer) & 7)) || !check(buffer, size, &header))
+        return false;
+
+    release();
+    memcpy(_params, header.params, sizeof(_params));
+    _data = static_cast<uint8_t*>(buffer) + sizeof(sketch_header_t);
+    _data_size = static_cast<size_t>(header.data_size);
+    _attached = true;
+    return true;
+}
+
+bool CSketchStorage::load(const void* buffer, size_t size)
+{
+    sketch_header_t header;
+    if (!check(buffer, size, &header))
+        return false;
+
+    memcpy(_params, header.params, sizeof(_params));
+    create(static_cast<size_t>(header.data_size));
+    memcpy(_data, static_cast<const char*>(buffer) + sizeof(sketch_header_t), _data_size);
+    return true;
+}
+
+void CSketchStorage::clear()
+{
+    if (_data != NULL)
+        memset(_data, 0, _data_size);
+}
+
+void CSketchStorage::create(size_t data_size)
+{
+    void* data = NULL;
+    release();
+    if (0 != posix_memalign(&data, 64, (data_size > 0)? data_size: 64))
+        throw std::bad_alloc();
+
+    _data = static_cast<uint8_t*>(data);
+    _data_size = data_size;
+    memset(_data, 0, _data_size);
+}
+
+bool CSketchStorage::same_shape(const CSketchStorage& other) const
+{
+    return (_data != NULL) && (other._data != NULL) && (_data_size == other._data_size)
+        && (0 == memcmp(_params, other._params, sizeof(_params)));
+}
+
+bool CSketchStorage::check(const void* buffer, size_t size, sketch_header_t* header)
+{
+    if ((NULL == buffer) || (size < sizeof(sketch_header_t)))
+        return false;
+
+    // buffer不要求对齐，复制出头部
+    memcpy(header, buffer, sizeof(*header));
+    if ((header->magic != SKETCH_MAGIC) || (header->type != _type) || (header->version != SKETCH_VERSION))
+        return false;
+    if (header->data_size > size - sizeof(sketch_header_t))
+        return false;
+
+    // restore在参数合法时才改变派生类的状态，失败时本对象不变
+    return restore(header->params, static_cast<size_t>(header->data_size));
+}
+
+void CSketchStorage::release()
+{
+    if (!_attached)
+        free(_data);
+    _data = NULL;
+    _data_size = 0;
+    _attached = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 数据的开头8字节为总次数，之后为depth行计数器
+
+#define COUNT_MIN_MAX_DEPTH 16
+#define COUNT_MIN_MAX_WIDTH (UINT32_C(1) << 30)
+
+CCountMinSketch::CCountMinSketch()
+    : CSketchStorage(sketch_count_min), _width(0), _depth(0)
+{
+}
+
+CCountMinSketch::CCountMinSketch(double epsilon, double delta)
+    : CSketchStorage(sketch_count_min)
+{
+    const double width = (epsilon > 0)? ceil(M_E / epsilon): COUNT_MIN_MAX_WIDTH;
+    const double depth = ((delta > 0) && (delta < 1))? ceil(log(1 / delta)): 1;
+
+    _width = 64;
+    while ((_width < width) && (_width < COUNT_MIN_MAX_WIDTH))
+        _width <<= 1;
+    _depth = static_cast<uint32_t>((depth < 1)? 1: ((depth > COUNT_MIN_MAX_DEPTH)? COUNT_MIN_MAX_DEPTH: depth));
+
+    _params[0] = _width;
+    _params[1] = _depth;
+    create(sizeof(uint64_t) + static_cast<size_t>(_width) * _depth * sizeof(uint32_t));
+}
+
+// 第i行的位置为hash+i*hash2（双重哈希），各行相互独立
+uint32_t CCountMinSketch::add_hash(uint64_t hash, uint32_t count)
+{
+    const uint64_t hash2 = CHashUtils::mix64(hash) | 1;
+    const uint32_t mask = _width - 1;
+    uint32_t* counters[COUNT_MIN_MAX_DEPTH];
+    uint32_t minimum = UINT32_MAX;
+
+    for (uint32_t i=0; i<_depth; ++i)
+    {
+        counters[i] = get_row(i) + ((hash + i * hash2) & mask);
+        if (*counters[i] < minimum)
+            minimum = *counters[i];
+    }
+
+    // 保守更新：只把小于新估计值的计数器加到新估计值
+    const uint32_t estimate = (minimum > UINT32_MAX - count)? UINT32_MAX: minimum + count;
+    for (uint32_t i=0; i<_depth; ++i)
+    {
+        if (*counters[i] < estimate)
+            *counters[i] = estimate;
+    }
+
+    uint64_t total;
+    memcpy(&total, _data, sizeof(total));
+    total = (total > UINT64_MAX - count)? UINT64_MAX: total + count;
+    memcpy(_data, &total, sizeof(total));
+    return estimate;
+}
+
+uint32_t CCountMinSketch::estimate_hash(uint64_t hash) const
+{
+    const uint64_t hash2 = CHashUtils::mix64(hash) | 1;
+    const uint32_t mask = _width - 1;
+    uint32_t minimum = UINT32_MAX;
+
+    for (uint32_t i=0; i<_depth; ++i)
+    {
+        const uint32_t counter = get_row(i)[(hash + i * hash2) & mask];
+        if (counter < minimum)
+            minimum = counter;
+    }
+    return minimum;
+}
+
+void CCountMinSketch::halve()
+{
+    uint32_t* counters = get_row(0);
+    const size_t number = static_cast<size_t>(_width) * _depth;
+    for (size_t i=0; i<number; ++i)
+        counters[i] >>= 1;
+
+    uint64_t total;
+    memcpy(&total, _data, sizeof(total));
+    total >>= 1;
+    memcpy(_data, &total, sizeof(total));
+}
+
+bool CCountMinSketch::merge(const CCountMinSketch& other)
+{
+    if (!same_shape(other))
+        return false;
+
+    uint32_t* counters = get_row(0);
+    const uint32_t* other_counters = other.get_row(0);
+    const size_t number = static_cast<size_t>(_width) * _depth;
+    for (size_t i=0; i<number; ++i)
+        counters[i] = (counters[i] > UINT32_MAX - other_counters[i])? UINT32_MAX: counters[i] + other_counters[i];
+
+    uint64_t total, other_total;
+    memcpy(&total, _data, sizeof(total));
+    memcpy(&other_total, other._data, sizeof(other_total));
+    total = (total > UINT64_MAX - other_total)? UINT64_MAX: total + other_total;
+    memcpy(_data, &total, sizeof(total));
+    return true;
+}
+
+uint64_t CCountMinSketch::get_total() const
+{
+    uint64_t total;
+    memcpy(&total, _data, sizeof(total));
+    return total;
+}
+
+bool CCountMinSketch::restore(const uint64_t* params, size_t data_size)
+{
+    const uint64_t width = params[0];
+    const uint64_t depth = params[1];
+    if ((width < 1) || (width > COUNT_MIN_MAX_WIDTH) || (0 != (width & (width - 1))) || (depth < 1) || (depth > COUNT_MIN_MAX_DEPTH))
+        return false;
+    if (data_size != sizeof(uint64_t) + width * depth * sizeof(uint32_t))
+        return false;
+
+    _width = static_cast<uint32_t>(width);
+    _depth = static_cast<uint32_t>(depth);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+#define HYPERLOGLOG_MIN_PRECISION 4
+#define HYPERLOGLOG_MAX_PRECISION 18
+
+CHyperLogLog::CHyperLogLog()
+    : CSketchStorage(sketch_hyperloglog), _precision(0)
+{
+}
+
+CHyperLogLog::CHyperLogLog(uint32_t precision)
+    : CSketchStorage(sketch_hyperloglog)
+{
+    _precision = (precision < HYPERLOGLOG_MIN_PRECISION)? HYPERLOGLOG_MIN_PRECISION: ((precision > HYPERLOGLOG_MAX_PRECISION)? HYPERLOGLOG_MAX_PRECISION: precision);
+    _params[0] = _precision;
+    create(static_cast<size_t>(1) << _precision);
+}
+
+// 高precision位选寄存器，其余位中第一个1的位置（从1开始）为秩，寄存器存放最大的秩
+bool CHyperLogLog::add_hash(uint64_t hash)
+{
+    const uint64_t index = hash >> (64 - _precision);
+    const uint64_t rest = (hash << _precision) | (UINT64_C(1) << (_precision - 1)); // 保证不为0，秩最多为64-precision+1
+    const uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+
+    if (_data[index] >= rank)
+        return false;
+    _data[index] = rank;
+    return true;
+}
+
+uint64_t CHyperLogLog::estimate() const
+{
+    const size_t m = static_cast<size_t>(1) << _precision;
+    double sum = 0;
+    size_t zeros = 0;
+
+    for (size_t i=0; i<m; ++i)
+    {
+        sum += ldexp(1.0, -static_cast<int>(_data[i]));
+        zeros += (0 == _data[i])? 1: 0;
+    }
+
+    double alpha;
+    if (16 == m)
+        alpha = 0.673;
+    else if (32 == m)
+        alpha = 0.697;
+    else if (64 == m)
+        alpha = 0.709;
+    else
+        alpha = 0.7213 / (1 + 1.079 / m);
+
+    // 小基数时原始估计偏大，改用线性计数；64位哈希不需要大基数修正
+    double estimate = alpha * m * m / sum;
+    if ((estimate <= 2.5 * m) && (zeros > 0))
+        estimate = m * log(static_cast<double>(m) / zeros);
+    return static_cast<uint64_t>(estimate + 0.5);
+}
+
+bool CHyperLogLog::merge(const CHyperLogLog& other)
+{
+    if (!same_shape(other))
+        return false;
+
+    for (size_t i=0; i<_data_size; ++i)
+    {
+        if (other._data[i] > _data[i])
+            _data[i] = other._data[i];
+    }
+    return true;
+}
+
+bool CHyperLogLog::restore(const uint64_t* params, size_t data_size)
+{
+    const uint64_t precision = params[0];
+    if ((precision < HYPERLOGLOG_MIN_PRECISION) || (precision > HYPERLOGLOG_MAX_PRECISION) || (data_size != (static_cast<size_t>(1) << precision)))
+        return false;
+
+    _precision = static_cast<uint32_t>(precision);
+    return true;
+}
+
+UTILS_NAMESPACE_END
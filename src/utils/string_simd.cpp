@@ -0,0 +1,1008 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "utils/string_simd.h"
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MOOON_STRING_SIMD 1
+#else
+#define MOOON_STRING_SIMD 0
+#endif
+UTILS_NAMESPACE_BEGIN
+
+static const char lower_hex_table[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+static const char upper_hex_table[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+static inline bool is_space_char(char c)
+{
+    return (' ' == c) || ('\t' == c) || ('\r' == c) || ('\n' == c);
+}
+
+// 须转义的字节（同mysql_escape_string）转义后的第二个字符，不须转义的为0
+static const char mysql_escape_table[256] =
+{
+    '0', 0, 0, 0, 0, 0, 0, 0, 0, 0, 'n', 0, 0, 'r', 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'Z', 0, 0, 0, 0, 0,
+    0, 0, '"', 0, 0, 0, 0, '\'', 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// 标量实现，也用于处理向量实现剩下的不足一个向量的部分
+
+// 将[from, from+25]范围内的字符的0x20位翻转，即大小写互换
+static void scalar_flip_case(char* str, size_t size, char from)
+{
+    for (size_t i=0; i<size; ++i)
+    {
+        if (static_cast<unsigned char>(str[i] - from) < 26)
+            str[i] ^= 0x20;
+    }
+}
+
+static size_t scalar_count_leading_spaces(const char* str, size_t size)
+{
+    size_t i = 0;
+    while ((i < size) && is_space_char(str[i])) ++i;
+    return i;
+}
+
+static size_t scalar_size_without_trailing_spaces(const char* str, size_t size)
+{
+    while ((size > 0) && is_space_char(str[size-1])) --size;
+    return size;
+}
+
+static size_t scalar_count_leading_digits(const char* str, size_t size)
+{
+    size_t i = 0;
+    while ((i < size) && (static_cast<unsigned char>(str[i] - '0') < 10)) ++i;
+    return i;
+}
+
+static size_t scalar_count_leading_ascii(const char* str, size_t size)
+{
+    size_t i = 0;
+    while ((i < size) && (static_cast<unsigned char>(str[i]) < 0x80)) ++i;
+    return i;
+}
+
+static bool scalar_is_alphabetic(const char* str, size_t size)
+{
+    for (size_t i=0; i<size; ++i)
+    {
+        if (static_cast<unsigned char>((str[i] | 0x20) - 'a') >= 26)
+            return false;
+    }
+
+    return true;
+}
+
+static void scalar_to_hex(const unsigned char* str, size_t size, char* hex, bool lowercase)
+{
+    const char* hex_table = lowercase? lower_hex_table: upper_hex_table;
+    for (size_t i=0; i<size; ++i)
+    {
+        hex[i*2] = hex_table[str[i] >> 4];
+        hex[i*2+1] = hex_table[str[i] & 0x0F];
+    }
+}
+
+static size_t scalar_find_first_of(const char* str, size_t size, char c1, char c2)
+{
+    size_t i = 0;
+    while ((i < size) && (str[i] != c1) && (str[i] != c2))
+        ++i;
+    return i;
+}
+
+static size_t scalar_count_char(const char* str, size_t size, char c)
+{
+    size_t count = 0;
+    for (size_t i=0; i<size; ++i)
+        count += (str[i] == c);
+    return count;
+}
+
+static size_t scalar_find_mysql_escape(const char* str, size_t size)
+{
+    size_t i = 0;
+    while ((i < size) && (0 == mysql_escape_table[static_cast<unsigned char>(str[i])]))
+        ++i;
+    return i;
+}
+
+static size_t scalar_find_json_escape(const char* str, size_t size)
+{
+    size_t i = 0;
+    while ((i < size) && (static_cast<unsigned char>(str[i]) >= 0x20) && (str[i] != '"') && (str[i] != '\\'))
+        ++i;
+    return i;
+}
+
+// 返回第一个不合法的UTF-8字符的偏移，合法时返回size：
+// 不允许超长编码、代理项（U+D800至U+DFFF）和大于U+10FFFF的，结尾不完整的字符也不合法
+static size_t scalar_find_invalid_utf8(const char* str, size_t size)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(str);
+    size_t i = 0;
+
+    while (i < size)
+    {
+        const unsigned char c = bytes[i];
+        if (c < 0x80)
+        {
+            ++i;
+            continue;
+        }
+
+        // 第二个字节的范围由首字节决定，其余的续字节都是[0x80, 0xBF]
+        size_t continuation_number;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if ((c < 0xC2) || (c > 0xF4))
+            return i;
+        if (c < 0xE0)
+        {
+            continuation_number = 1;
+        }
+        else if (c < 0xF0)
+        {
+            continuation_number = 2;
+            if (0xE0 == c)
+                low = 0xA0;
+            else if (0xED == c)
+                high = 0x9F;
+        }
+        else
+        {
+            continuation_number = 3;
+            if (0xF0 == c)
+                low = 0x90;
+            else if (0xF4 == c)
+                high = 0x8F;
+        }
+
+        if ((size - i <= continuation_number) || (bytes[i+1] < low) || (bytes[i+1] > high))
+            return i;
+        for (size_t k=2; k<=continuation_number; ++k)
+        {
+            if ((bytes[i+k] & 0xC0) != 0x80)
+                return i;
+        }
+        i += continuation_number + 1;
+    }
+
+    return size;
+}
+
+// 向量实现发现[offset, offset+向量大小)中有错误时，从之前最近的字符边界开始逐字节查找，
+// 错误可能由前一个向量结尾处不完整的字符引起，所以从offset-3开始跳过续字节
+static size_t locate_invalid_utf8(const char* str, size_t size, size_t offset)
+{
+    size_t start = (offset > 3)? offset - 3: 0;
+    while ((start < offset) && ((static_cast<unsigned char>(str[start]) & 0xC0) == 0x80))
+        ++start;
+    return start + scalar_find_invalid_utf8(str+start, size-start);
+}
+
+#if MOOON_STRING_SIMD == 1
+////////////////////////////////////////////////////////////////////////////////
+// 范围判断统一用有符号比较实现：c加上(128-from)后，[from, from+n)正好落在[-128, -128+n)，
+// 因此只需一次加法和一次比较
+
+// SSE4.2，一次16字节
+__attribute__((target("sse4.2")))
+static void sse42_flip_case(char* str, size_t size, char from)
+{
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(128 - from));
+    const __m128i bound = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        __m128i mask = _mm_cmplt_epi8(_mm_add_epi8(x, shift), bound);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(str+i), _mm_xor_si128(x, _mm_and_si128(mask, flip)));
+    }
+
+    scalar_flip_case(str+i, size-i, from);
+}
+
+__attribute__((target("sse4.2")))
+static inline int sse42_space_mask(const char* str)
+{
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+    __m128i mask = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'))));
+    return _mm_movemask_epi8(mask);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_count_leading_spaces(const char* str, size_t size)
+{
+    size_t i = 0;
+    for (; i+16<=size; i+=16)
+    {
+        int mask = sse42_space_mask(str+i);
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i + scalar_count_leading_spaces(str+i, size-i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_size_without_trailing_spaces(const char* str, size_t size)
+{
+    for (; size>=16; size-=16)
+    {
+        int mask = sse42_space_mask(str+size-16);
+        if (mask != 0xFFFF)
+            return size - 16 + (32 - __builtin_clz(~mask & 0xFFFF));
+    }
+
+    return scalar_size_without_trailing_spaces(str, size);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_count_leading_digits(const char* str, size_t size)
+{
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(128 - '0'));
+    const __m128i bound = _mm_set1_epi8(static_cast<char>(-128 + 10));
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        int mask = _mm_movemask_epi8(_mm_cmplt_epi8(_mm_add_epi8(x, shift), bound));
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i + scalar_count_leading_digits(str+i, size-i);
+}
+
+// 最高位正好是movemask取的位
+__attribute__((target("sse4.2")))
+static size_t sse42_count_leading_ascii(const char* str, size_t size)
+{
+    size_t i = 0;
+    for (; i+16<=size; i+=16)
+    {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scalar_count_leading_ascii(str+i, size-i);
+}
+
+__attribute__((target("sse4.2")))
+static bool sse42_is_alphabetic(const char* str, size_t size)
+{
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(128 - 'a'));
+    const __m128i bound = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i lower = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i)), lower);
+        if (_mm_movemask_epi8(_mm_cmplt_epi8(_mm_add_epi8(x, shift), bound)) != 0xFFFF)
+            return false;
+    }
+
+    return scalar_is_alphabetic(str+i, size-i);
+}
+
+// 高低半字节交错排列后，用pshufb查表
+__attribute__((target("sse4.2")))
+static void sse42_to_hex(const unsigned char* str, size_t size, char* hex, bool lowercase)
+{
+    const __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lowercase? lower_hex_table: upper_hex_table));
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(x, 4), low_mask);
+        __m128i low = _mm_and_si128(x, low_mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hex+i*2), _mm_shuffle_epi8(table, _mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hex+i*2+16), _mm_shuffle_epi8(table, _mm_unpackhi_epi8(high, low)));
+    }
+
+    scalar_to_hex(str+i, size-i, hex+i*2, lowercase);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_find_first_of(const char* str, size_t size, char c1, char c2)
+{
+    const __m128i x1 = _mm_set1_epi8(c1);
+    const __m128i x2 = _mm_set1_epi8(c2);
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, x1), _mm_cmpeq_epi8(x, x2)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scalar_find_first_of(str+i, size-i, c1, c2);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_count_char(const char* str, size_t size, char c)
+{
+    const __m128i xc = _mm_set1_epi8(c);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, xc)));
+    }
+
+    return count + scalar_count_char(str+i, size-i, c);
+}
+
+// 须转义的7个字节逐个比较，大多数数据中没有须转义的字节，一次比较得到整个向量的结果
+__attribute__((target("sse4.2")))
+static inline int sse42_mysql_escape_mask(__m128i x)
+{
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_setzero_si128()), _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\032'))));
+    m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\\')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\''))));
+    return _mm_movemask_epi8(_mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('"'))));
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_find_mysql_escape(const char* str, size_t size)
+{
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        int mask = sse42_mysql_escape_mask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scalar_find_mysql_escape(str+i, size-i);
+}
+
+// 控制字符以无符号的min判断：min(x, 0x1f)==x即x<=0x1f
+__attribute__((target("sse4.2")))
+static size_t sse42_find_json_escape(const char* str, size_t size)
+{
+    const __m128i max_ctrl = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+
+    for (; i+16<=size; i+=16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, max_ctrl), x), _mm_cmpeq_epi8(x, quote));
+        int mask = _mm_movemask_epi8(_mm_or_si128(m, _mm_cmpeq_epi8(x, backslash)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scalar_find_json_escape(str+i, size-i);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// UTF-8校验（Keiser和Lemire的查表法）：每个字节和它前面的一个字节的高低半字节分别以pshufb查表，
+// 三个表的结果相与，每一位代表一类错误（太短、太长、超长编码、代理项、超出U+10FFFF和多余的续字节），
+// 再由前面第二和第三个字节判断哪些续字节是3和4字节字符所需要的，和“多余的续字节”相消
+
+#define UTF8_TOO_SHORT      (1 << 0) // 11______ 0_______或11______ 11______
+#define UTF8_TOO_LONG       (1 << 1) // 0_______ 10______
+#define UTF8_OVERLONG_3     (1 << 2) // 11100000 100_____
+#define UTF8_TOO_LARGE      (1 << 3) // 11110100 1001____等
+#define UTF8_SURROGATE      (1 << 4) // 11101101 101_____
+#define UTF8_OVERLONG_2     (1 << 5) // 1100000_ 10______
+#define UTF8_TOO_LARGE_1000 (1 << 6) // 11110101 1000____等
+#define UTF8_OVERLONG_4     (1 << 6) // 11110000 1000____
+#define UTF8_TWO_CONTS      (1 << 7) // 10______ 10______
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// 前一个字节的高半字节
+static const unsigned char utf8_byte_1_high_table[16] =
+{
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+};
+
+// 前一个字节的低半字节
+static const unsigned char utf8_byte_1_low_table[16] =
+{
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+};
+
+// 当前字节的高半字节
+static const unsigned char utf8_byte_2_high_table[16] =
+{
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+};
+
+// 向量结尾不完整的字符：最后一个字节大于等于0xC0，或倒数第二个大于等于0xE0，或倒数第三个大于等于0xF0
+static const unsigned char utf8_incomplete_max[32] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+};
+
+// input为当前的16字节，prev_input为之前的16字节，返回不为0的字节表示有错误
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_utf8_block_error(__m128i input, __m128i prev_input)
+{
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    const __m128i byte_1_high = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_byte_1_high_table)),
+                                                 _mm_and_si128(_mm_srli_epi16(prev1, 4), low_mask));
+    const __m128i byte_1_low = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_byte_1_low_table)),
+                                                _mm_and_si128(prev1, low_mask));
+    const __m128i byte_2_high = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_byte_2_high_table)),
+                                                 _mm_and_si128(_mm_srli_epi16(input, 4), low_mask));
+    const __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // 3和4字节字符的第三和第四个字节须为续字节，只有111_____减去0x60、1111____减去0x70后不小于0x80
+    const __m128i is_third_byte = _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 14), _mm_set1_epi8(static_cast<char>(0xE0-0x80)));
+    const __m128i is_fourth_byte = _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 13), _mm_set1_epi8(static_cast<char>(0xF0-0x80)));
+    const __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_find_invalid_utf8(const char* str, size_t size)
+{
+    const __m128i incomplete_max = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_incomplete_max+16));
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i<size; i+=16)
+    {
+        // 不足16字节的以0补齐，0是ASCII，不影响结果
+        __m128i input;
+        if (i+16 <= size)
+        {
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str+i));
+        }
+        else
+        {
+            char tail[16] = { 0 };
+            memcpy(tail, str+i, size-i);
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+        }
+
+        __m128i error;
+        if (0 == _mm_movemask_epi8(input))
+        {
+            error = prev_incomplete;
+            prev_incomplete = _mm_setzero_si128();
+        }
+        else
+        {
+            error = sse42_utf8_block_error(input, prev_input);
+            prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+        }
+        if (!_mm_testz_si128(error, error))
+            return locate_invalid_utf8(str, size, i);
+        prev_input = input;
+    }
+
+    // 最后一个向量结尾不完整，只在size为16的倍数时出现，否则补齐的0已使它成为“太短”
+    if (!_mm_testz_si128(prev_incomplete, prev_incomplete))
+        return locate_invalid_utf8(str, size, size);
+    return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2，一次32字节，剩下的交给SSE4.2实现
+
+__attribute__((target("avx2")))
+static void avx2_flip_case(char* str, size_t size, char from)
+{
+    const __m256i shift = _mm256_set1_epi8(static_cast<char>(128 - from));
+    const __m256i bound = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        __m256i mask = _mm256_cmpgt_epi8(bound, _mm256_add_epi8(x, shift));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(str+i), _mm256_xor_si256(x, _mm256_and_si256(mask, flip)));
+    }
+
+    sse42_flip_case(str+i, size-i, from);
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t avx2_space_mask(const char* str)
+{
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str));
+    __m256i mask = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'))));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_count_leading_spaces(const char* str, size_t size)
+{
+    size_t i = 0;
+    for (; i+32<=size; i+=32)
+    {
+        uint32_t mask = avx2_space_mask(str+i);
+        if (mask != 0xFFFFFFFFU)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i + sse42_count_leading_spaces(str+i, size-i);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_size_without_trailing_spaces(const char* str, size_t size)
+{
+    for (; size>=32; size-=32)
+    {
+        uint32_t mask = avx2_space_mask(str+size-32);
+        if (mask != 0xFFFFFFFFU)
+            return size - __builtin_clz(~mask);
+    }
+
+    return sse42_size_without_trailing_spaces(str, size);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_count_leading_digits(const char* str, size_t size)
+{
+    const __m256i shift = _mm256_set1_epi8(static_cast<char>(128 - '0'));
+    const __m256i bound = _mm256_set1_epi8(static_cast<char>(-128 + 10));
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(bound, _mm256_add_epi8(x, shift))));
+        if (mask != 0xFFFFFFFFU)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i + sse42_count_leading_digits(str+i, size-i);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_count_leading_ascii(const char* str, size_t size)
+{
+    size_t i = 0;
+    for (; i+32<=size; i+=32)
+    {
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i))));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + sse42_count_leading_ascii(str+i, size-i);
+}
+
+__attribute__((target("avx2")))
+static bool avx2_is_alphabetic(const char* str, size_t size)
+{
+    const __m256i shift = _mm256_set1_epi8(static_cast<char>(128 - 'a'));
+    const __m256i bound = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i)), lower);
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(bound, _mm256_add_epi8(x, shift)))) != 0xFFFFFFFFU)
+            return false;
+    }
+
+    return sse42_is_alphabetic(str+i, size-i);
+}
+
+// unpack在每个128位通道内进行，交错后再用permute2x128把两个通道的结果按顺序拼起来
+__attribute__((target("avx2")))
+static void avx2_to_hex(const unsigned char* str, size_t size, char* hex, bool lowercase)
+{
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lowercase? lower_hex_table: upper_hex_table)));
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+        __m256i low = _mm256_and_si256(x, low_mask);
+        __m256i first = _mm256_unpacklo_epi8(high, low);  // 0~7和16~23
+        __m256i second = _mm256_unpackhi_epi8(high, low); // 8~15和24~31
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hex+i*2), _mm256_shuffle_epi8(table, _mm256_permute2x128_si256(first, second, 0x20)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hex+i*2+32), _mm256_shuffle_epi8(table, _mm256_permute2x128_si256(first, second, 0x31)));
+    }
+
+    sse42_to_hex(str+i, size-i, hex+i*2, lowercase);
+}
+__attribute__((target("avx2")))
+static size_t avx2_find_first_of(const char* str, size_t size, char c1, char c2)
+{
+    const __m256i x1 = _mm256_set1_epi8(c1);
+    const __m256i x2 = _mm256_set1_epi8(c2);
+    size_t i = 0;
+
+    // 一次处理64字节，两个掩码合并后只判断一次，找到后再定位
+    for (; i+64<=size; i+=64)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i+32));
+        uint32_t mask_a = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(a, x1), _mm256_cmpeq_epi8(a, x2))));
+        uint32_t mask_b = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(b, x1), _mm256_cmpeq_epi8(b, x2))));
+        uint64_t mask = (static_cast<uint64_t>(mask_b) << 32) | mask_a;
+        if (mask != 0)
+            return i + __builtin_ctzll(mask);
+    }
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, x1), _mm256_cmpeq_epi8(x, x2))));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + sse42_find_first_of(str+i, size-i, c1, c2);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t avx2_count_char(const char* str, size_t size, char c)
+{
+    const __m256i xc = _mm256_set1_epi8(c);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        count += __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, xc))));
+    }
+
+    return count + sse42_count_char(str+i, size-i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find_mysql_escape(const char* str, size_t size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i ctrl_z = _mm256_set1_epi8('\032');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i single_quote = _mm256_set1_epi8('\'');
+    const __m256i double_quote = _mm256_set1_epi8('"');
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(x, zero), _mm256_cmpeq_epi8(x, lf));
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(x, cr), _mm256_cmpeq_epi8(x, ctrl_z)));
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(x, backslash), _mm256_cmpeq_epi8(x, single_quote)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(m, _mm256_cmpeq_epi8(x, double_quote))));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + sse42_find_mysql_escape(str+i, size-i);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find_json_escape(const char* str, size_t size)
+{
+    const __m256i max_ctrl = _mm256_set1_epi8(0x1f);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    size_t i = 0;
+
+    for (; i+32<=size; i+=32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(x, max_ctrl), x), _mm256_cmpeq_epi8(x, quote));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(m, _mm256_cmpeq_epi8(x, backslash))));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + sse42_find_json_escape(str+i, size-i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_utf8_block_error(__m256i input, __m256i prev_input)
+{
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    // 各128位通道的前一个字节，跨通道的由permute2x128取得
+    const __m256i prev_shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, prev_shifted, 15);
+    const __m256i byte_1_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_byte_1_high_table))),
+                                                    _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_mask));
+    const __m256i byte_1_low = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_byte_1_low_table))),
+                                                   _mm256_and_si256(prev1, low_mask));
+    const __m256i byte_2_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8_byte_2_high_table))),
+                                                    _mm256_and_si256(_mm256_srli_epi16(input, 4), low_mask));
+    const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    const __m256i is_third_byte = _mm256_subs_epu8(_mm256_alignr_epi8(input, prev_shifted, 14), _mm256_set1_epi8(static_cast<char>(0xE0-0x80)));
+    const __m256i is_fourth_byte = _mm256_subs_epu8(_mm256_alignr_epi8(input, prev_shifted, 13), _mm256_set1_epi8(static_cast<char>(0xF0-0x80)));
+    const __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must_be_continuation, special_cases);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find_invalid_utf8(const char* str, size_t size)
+{
+    const __m256i incomplete_max = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(utf8_incomplete_max));
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i<size; i+=32)
+    {
+        __m256i input;
+        if (i+32 <= size)
+        {
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str+i));
+        }
+        else
+        {
+            char tail[32] = { 0 };
+            memcpy(tail, str+i, size-i);
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+        }
+
+        __m256i error;
+        if (0 == _mm256_movemask_epi8(input))
+        {
+            error = prev_incomplete;
+            prev_incomplete = _mm256_setzero_si256();
+        }
+        else
+        {
+            error = avx2_utf8_block_error(input, prev_input);
+            prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+        }
+        if (!_mm256_testz_si256(error, error))
+            return locate_invalid_utf8(str, size, i);
+        prev_input = input;
+    }
+
+    if (!_mm256_testz_si256(prev_incomplete, prev_incomplete))
+        return locate_invalid_utf8(str, size, size);
+    return size;
+}
+#endif // MOOON_STRING_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+struct StringKernels
+{
+    CStringSimd::isa_t isa;
+    void (*flip_case)(char*, size_t, char);
+    size_t (*count_leading_spaces)(const char*, size_t);
+    size_t (*size_without_trailing_spaces)(const char*, size_t);
+    size_t (*count_leading_digits)(const char*, size_t);
+    size_t (*count_leading_ascii)(const char*, size_t);
+    bool (*is_alphabetic)(const char*, size_t);
+    void (*to_hex)(const unsigned char*, size_t, char*, bool);
+    size_t (*find_first_of)(const char*, size_t, char, char);
+    size_t (*count_char)(const char*, size_t, char);
+    size_t (*find_mysql_escape)(const char*, size_t);
+    size_t (*find_json_escape)(const char*, size_t);
+    size_t (*find_invalid_utf8)(const char*, size_t);
+};
+
+static const StringKernels scalar_kernels =
+{
+    CStringSimd::isa_scalar, scalar_flip_case, scalar_count_leading_spaces, scalar_size_without_trailing_spaces,
+    scalar_count_leading_digits, scalar_count_leading_ascii, scalar_is_alphabetic, scalar_to_hex,
+    scalar_find_first_of, scalar_count_char, scalar_find_mysql_escape, scalar_find_json_escape, scalar_find_invalid_utf8
+};
+
+#if MOOON_STRING_SIMD == 1
+static const StringKernels sse42_kernels =
+{
+    CStringSimd::isa_sse42, sse42_flip_case, sse42_count_leading_spaces, sse42_size_without_trailing_spaces,
+    sse42_count_leading_digits, sse42_count_leading_ascii, sse42_is_alphabetic, sse42_to_hex,
+    sse42_find_first_of, sse42_count_char, sse42_find_mysql_escape, sse42_find_json_escape, sse42_find_invalid_utf8
+};
+
+static const StringKernels avx2_kernels =
+{
+    CStringSimd::isa_avx2, avx2_flip_case, avx2_count_leading_spaces, avx2_size_without_trailing_spaces,
+    avx2_count_leading_digits, avx2_count_leading_ascii, avx2_is_alphabetic, avx2_to_hex,
+    avx2_find_first_of, avx2_count_char, avx2_find_mysql_escape, avx2_find_json_escape, avx2_find_invalid_utf8
+};
+#endif // MOOON_STRING_SIMD
+
+static const StringKernels* select_kernels(CStringSimd::isa_t isa)
+{
+#if MOOON_STRING_SIMD == 1
+    if (isa >= CStringSimd::isa_avx2)
+        return &avx2_kernels;
+    if (isa >= CStringSimd::isa_sse42)
+        return &sse42_kernels;
+#endif // MOOON_STRING_SIMD
+    return &scalar_kernels;
+}
+
+// 函数内的静态变量，保证在其它全局对象的构造函数中使用时也已初始化
+static const StringKernels*& kernels()
+{
+    static const StringKernels* selected = select_kernels(CStringSimd::get_supported_isa());
+    return selected;
+}
+
+CStringSimd::isa_t CStringSimd::get_isa()
+{
+    return kernels()->isa;
+}
+
+CStringSimd::isa_t CStringSimd::get_supported_isa()
+{
+#if MOOON_STRING_SIMD == 1
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return isa_avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return isa_sse42;
+#endif // MOOON_STRING_SIMD
+    return isa_scalar;
+}
+
+CStringSimd::isa_t CStringSimd::set_isa(isa_t isa)
+{
+    const isa_t supported_isa = get_supported_isa();
+    kernels() = select_kernels((isa > supported_isa)? supported_isa: isa);
+    return kernels()->isa;
+}
+
+void CStringSimd::to_upper(char* str, size_t size)
+{
+    kernels()->flip_case(str, size, 'a');
+}
+
+void CStringSimd::to_lower(char* str, size_t size)
+{
+    kernels()->flip_case(str, size, 'A');
+}
+
+size_t CStringSimd::count_leading_spaces(const char* str, size_t size)
+{
+    return kernels()->count_leading_spaces(str, size);
+}
+
+size_t CStringSimd::size_without_trailing_spaces(const char* str, size_t size)
+{
+    return kernels()->size_without_trailing_spaces(str, size);
+}
+
+size_t CStringSimd::count_leading_digits(const char* str, size_t size)
+{
+    return kernels()->count_leading_digits(str, size);
+}
+
+size_t CStringSimd::count_leading_ascii(const char* str, size_t size)
+{
+    return kernels()->count_leading_ascii(str, size);
+}
+
+bool CStringSimd::is_alphabetic(const char* str, size_t size)
+{
+    return kernels()->is_alphabetic(str, size);
+}
+
+void CStringSimd::to_hex(const unsigned char* str, size_t size, char* hex, bool lowercase)
+{
+    kernels()->to_hex(str, size, hex, lowercase);
+}
+
+size_t CStringSimd::find_first_of(const char* str, size_t size, char c1, char c2)
+{
+    return kernels()->find_first_of(str, size, c1, c2);
+}
+
+size_t CStringSimd::count_char(const char* str, size_t size, char c)
+{
+    return kernels()->count_char(str, size, c);
+}
+
+size_t CStringSimd::find_mysql_escape(const char* str, size_t size)
+{
+    return kernels()->find_mysql_escape(str, size);
+}
+
+size_t CStringSimd::find_json_escape(const char* str, size_t size)
+{
+    return kernels()->find_json_escape(str, size);
+}
+
+size_t CStringSimd::find_invalid_utf8(const char* str, size_t size)
+{
+    return kernels()->find_invalid_utf8(str, size);
+}
+
+// 不须转义的连续字节整段复制，只有须转义的字节逐个处理
+size_t CStringSimd::escape_mysql(const char* str, size_t size, char* escaped)
+{
+    size_t (*find)(const char*, size_t) = kernels()->find_mysql_escape;
+    char* out = escaped;
+
+    for (size_t i=0; i<size;)
+    {
+        const size_t n = find(str+i, size-i);
+        memcpy(out, str+i, n);
+        out += n;
+        i += n;
+        if (i < size)
+        {
+            *out++ = '\\';
+            *out++ = mysql_escape_table[static_cast<unsigned char>(str[i++])];
+        }
+    }
+
+    return static_cast<size_t>(out - escaped);
+}
+
+UTILS_NAMESPACE_END
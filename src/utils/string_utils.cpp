@@ -17,6 +17,9 @@
  * Author: jian yi, eyjian@qq.com or eyjian@gmail.com
  */
 #include "utils/string_utils.h"
+#include "utils/codec.h"
+#include "utils/crc32.h"
+#include "utils/string_simd.h"
 #include "utils/scoped_ptr.h"
 #include "utils/tokener.h"
 //#include <alloca.h>
@@ -24,89 +27,89 @@
 #include <limits>
 #include <stdarg.h>
 #include <zlib.h>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define MOOON_HAVE_TO_CHARS 1
+#else
+#define MOOON_HAVE_TO_CHARS 0
+#endif
 UTILS_NAMESPACE_BEGIN
 
 /***
-  * 快速字符串转换成整数模板通用函数
+  * 快速字符串转换成整数模板通用函数，一遍完成检查和转换，不使用locale
   * @str: 需要被转换的字符串
-  * @result: 存储转换后的结果
-  * @max_length: 该整数类型对应的字符串的最多字符个数，不包括结尾符
-  * @converted_length: 需要转换的字符串长度，如果为0则表示转换整个字符串
+  * @result: 存储转换后的结果，转换失败时不修改
+  * @converted_length: 需要转换的字符串长度（包括负号），如果为0则表示转换整个字符串
   * @ignored_zero: 是否忽略开头的0
-  * @return: 如果转换成功返回true, 否则返回false
+  * @return: 如果转换成功返回true，溢出或含非数字字符返回false
   */
-template <typename IntType>
-static bool fast_string2int(const char* str, IntType& result, uint8_t max_length, uint8_t converted_length, bool ignored_zero)
+template <typename IntType, typename UIntType>
+static bool fast_string2int(const char* str, IntType& result, uint8_t converted_length, bool ignored_zero)
 {
-    bool negative = false;
-    const char* tmp_str = str;
     if (NULL == str) return false;
 
-    // 处理负数
-    if ('-' == tmp_str[0])
-    {
-        // 负数
-        negative = true;
-        ++tmp_str;
-    }
+    const char* iter = str;
+    const char* end = (0 == converted_length)? NULL: str+converted_length;
+    const bool negative = ('-' == *iter);
+    if (negative) ++iter;
 
     // 处理空字符串
-    if ('\0' == tmp_str[0]) return false;
+    if (('\0' == *iter) || (iter == end)) return false;
 
-    // 处理0打头的
-    if ('0' == tmp_str[0])
+    // 处理0打头的，如果是0开头，则只能有一位数字，除非忽略开头的0
+    if ('0' == *iter)
     {
-        // 如果是0开头，则只能有一位数字
-        if (('\0' == tmp_str[1]) || (1 == converted_length))
+        ++iter;
+        if (('\0' == *iter) || (iter == end))
         {
             result = 0;
             return true;
         }
-        else
+
+        if (!ignored_zero) return false;
+        while (('0' == *iter) && (iter != end)) ++iter;
+        if (('\0' == *iter) || (iter == end))
         {
-            if (!ignored_zero) return false;
-            for (;;)
-            {
-                ++tmp_str;
-                if (tmp_str - str > max_length-1) return false;
-                if (*tmp_str != '0') break;
-            }
-            if ('\0' == *tmp_str)
-            {
-                result = 0;
-                return true;
-            }
+            result = 0;
+            return true;
         }
     }
 
-    // 检查第一个字符
-    if ((*tmp_str < '0') || (*tmp_str > '9')) return false;
-    result = (*tmp_str - '0');
+    // 无符号类型只允许“-0”
+    const UIntType limit = negative
+        ? (std::numeric_limits<IntType>::is_signed? static_cast<UIntType>(std::numeric_limits<IntType>::max()) + 1: 0)
+        : static_cast<UIntType>(std::numeric_limits<IntType>::max());
+    const UIntType cutoff = limit / 10;
+    const unsigned int cutlim = static_cast<unsigned int>(limit % 10);
+    UIntType value = 0;
 
-    while ((0 == converted_length) || (tmp_str - str < converted_length-1))
+    do
     {
-        ++tmp_str;
-        if ('\0' == *tmp_str) break;
-        if (tmp_str - str > max_length-1) return false;
+        const unsigned int digit = static_cast<unsigned char>(*iter - '0');
+        if (digit > 9) return false;
+        if ((value > cutoff) || ((value == cutoff) && (digit > cutlim))) return false; // 溢出
 
-        if ((*tmp_str < '0') || (*tmp_str > '9')) return false;
+        value = value * 10 + digit;
+        ++iter;
+    } while ((*iter != '\0') && (iter != end));
 
-        result = result * 10;
-        result += (*tmp_str - '0');
-    }
-
-    if (negative)
-        result = -result;
+    result = negative? static_cast<IntType>(UIntType(0) - value): static_cast<IntType>(value);
     return true;
 }
 
 uint32_t CStringUtils::crc32(const std::string& str, uint32_t crc)
 {
-    // #include <zconf.h>
-    // typedef unsigned int   uInt;  /* 16 bits or more */
-    // typedef unsigned long  uLong; /* 32 bits or more */
-    // uLong ZEXPORT crc32   OF((uLong crc, const Bytef *buf, uInt len));
-    return (uint32_t)::crc32((uLong)crc, (Bytef*)str.data(), (uInt)str.size());
+    // 结果同zlib的crc32
+    return CCrc32::crc32(str.data(), str.size(), crc);
+}
+
+uint32_t CStringUtils::crc32c(const std::string& str, uint32_t crc)
+{
+    return CCrc32::crc32c(str.data(), str.size(), crc);
 }
 
 std::string& CStringUtils::reverse_string(std::string* str)
@@ -166,37 +169,20 @@ std::string CStringUtils::remove_last(const std::string& source, const std::stri
 
 char* CStringUtils::to_upper(char* source)
 {
-    char* tmp_source = source;
-    while (*tmp_source != '\0')
-    {
-        if ((*tmp_source >= 'a') && (*tmp_source <= 'z'))
-            *tmp_source += 'A' - 'a';
-
-        ++tmp_source;
-    }
-
+    CStringSimd::to_upper(source, strlen(source));
     return source;
 }
 
 char* CStringUtils::to_lower(char* source)
 {
-    char* tmp_source = source;
-    while (*tmp_source != '\0')
-    {
-        if ((*tmp_source >= 'A') && (*tmp_source <= 'Z'))
-            *tmp_source += 'a' - 'A';
-
-        ++tmp_source;
-    }
-
+    CStringSimd::to_lower(source, strlen(source));
     return source;
 }
 
 std::string& CStringUtils::to_upper(std::string& source)
 {
-    // 只修改大小写，可以这样做
-    char* tmp_source = (char *)source.c_str();
-    to_upper(tmp_source);
+    if (!source.empty())
+        CStringSimd::to_upper(&source[0], source.size());
     return source;
 }
 
@@ -208,9 +194,8 @@ std::string CStringUtils::to_upper(const std::string& source)
 
 std::string& CStringUtils::to_lower(std::string& source)
 {
-    // 只修改大小写，可以这样做
-    char* tmp_source = (char *)source.c_str();
-    to_lower(tmp_source);
+    if (!source.empty())
+        CStringSimd::to_lower(&source[0], source.size());
     return source;
 }
 
@@ -226,106 +211,49 @@ bool CStringUtils::is_space(char c)
     return (' ' == c) || ('\t' == c) || ('\r' == c) || ('\n' == c);
 }
 
-// 不使用trim_left和trim_right组合实现，以保持效率
+// 左边只去掉空格，右边去掉所有空白字符
 void CStringUtils::trim(char* source)
 {
-    char* space = NULL;
-    char* tmp_source = source;
-    while (' ' == *tmp_source) ++tmp_source;
+    size_t left = 0;
+    while (' ' == source[left]) ++left;
 
-    for (;;)
-    {
-        *source = *tmp_source;
-        if ('\0' == *tmp_source)
-        {
-            if (space != NULL)
-                *space = '\0';
-            break;
-        }
-        else if (is_space(*tmp_source))
-        {
-            if (NULL == space)
-                space = source;
-        }
-        else
-        {
-            space = NULL;
-        }
-
-        ++source;
-        ++tmp_source;
-    }
+    const size_t size = CStringSimd::size_without_trailing_spaces(source+left, strlen(source+left));
+    memmove(source, source+left, size);
+    source[size] = '\0';
 }
 
 void CStringUtils::trim_left(char* source)
 {
-    char* tmp_source = source;
-    while (is_space(*tmp_source)) ++tmp_source;
-
-    for (;;)
-    {
-        *source = *tmp_source;
-        if ('\0' == *tmp_source) break;
-
-        ++source;
-        ++tmp_source;
-    }
+    const size_t size = strlen(source);
+    const size_t left = CStringSimd::count_leading_spaces(source, size);
+    if (left > 0)
+        memmove(source, source+left, size-left+1);
 }
 
 void CStringUtils::trim_right(char* source)
 {
-    char* space = NULL;
-    char* tmp_source = source;
-
-    for (;;)
-    {
-        if ('\0' == *tmp_source)
-        {
-            if (space != NULL)
-                *space = '\0';
-            break;
-        }
-        else if (is_space(*tmp_source))
-        {
-            if (NULL == space)
-                space = tmp_source;
-        }
-        else
-        {
-            space = NULL;
-        }
-
-        ++tmp_source;
-    }
+    source[CStringSimd::size_without_trailing_spaces(source, strlen(source))] = '\0';
 }
 
 std::string& CStringUtils::trim(std::string& source)
 {
-    trim_left(source);
     trim_right(source);
+    trim_left(source);
     return source;
 }
 
 std::string CStringUtils::trim(const std::string& source)
 {
     std::string str(source.c_str(), source.size());
-    trim_left(str);
     trim_right(str);
+    trim_left(str);
     return str;
 }
 
+// 原地修改，不分配内存
 std::string& CStringUtils::trim_left(std::string& source)
 {
-    // 不能直接对c_str()进行修改，因为长度发生了变化
-    size_t length = source.length();
-    char* tmp_source = new char[length+1];
-    DeleteHelper<char> dh(tmp_source, true);
-
-    strncpy(tmp_source, source.c_str(), length);
-    tmp_source[length] = '\0';
-
-    trim_left(tmp_source);
-    source = tmp_source;
+    source.erase(0, CStringSimd::count_leading_spaces(source.data(), source.size()));
     return source;
 }
 
@@ -338,16 +266,7 @@ std::string CStringUtils::trim_left(const std::string& source)
 
 std::string& CStringUtils::trim_right(std::string& source)
 {
-    // 不能直接对c_str()进行修改，因为长度发生了变化
-    size_t length = source.length();
-    char* tmp_source = new char[length+1];
-    DeleteHelper<char> dh(tmp_source, true);
-
-    strncpy(tmp_source, source.c_str(), length);
-    tmp_source[length] = '\0';
-
-    trim_right(tmp_source);
-    source = tmp_source;
+    source.resize(CStringSimd::size_without_trailing_spaces(source.data(), source.size()));
     return source;
 }
 
@@ -364,6 +283,18 @@ std::string CStringUtils::trim_right(const std::string& source)
 // std::stoul() throw (std::invalid_argument,std::out_of_range)
 bool CStringUtils::string2double(const char* source, double& result)
 {
+#if MOOON_HAVE_TO_CHARS == 1
+    // 不受locale影响，不能完整解析的（如带前导空格、“+”号和十六进制）再交给strtod
+    const char* end = source + strlen(source);
+    double value;
+    const std::from_chars_result from_result = std::from_chars(source, end, value);
+    if ((from_result.ec == std::errc()) && (from_result.ptr == end))
+    {
+        result = value;
+        return true;
+    }
+#endif // MOOON_HAVE_TO_CHARS
+
     char* endptr = NULL;
     double result_ = strtod(source, &endptr);
     if ((endptr != NULL) && ('\0' == *endptr))
@@ -411,14 +342,7 @@ bool CStringUtils::string2int8(const char* source, int8_t& result, uint8_t conve
 
 bool CStringUtils::string2int(const char* source, int8_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    int16_t value = 0;
-
-    if (!string2int16(source, value, converted_length, ignored_zero)) return false;
-    if (value < std::numeric_limits<int8_t>::min() 
-     || value > std::numeric_limits<int8_t>::max()) return false;
-    
-    result = (int8_t)value;
-    return true;
+    return fast_string2int<int8_t, uint8_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2int16(const char* source, int16_t& result, uint8_t converted_length, bool ignored_zero)
@@ -428,14 +352,7 @@ bool CStringUtils::string2int16(const char* source, int16_t& result, uint8_t con
 
 bool CStringUtils::string2int(const char* source, int16_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    int32_t value = 0;
-
-    if (!string2int32(source, value, converted_length, ignored_zero)) return false;
-    if (value < std::numeric_limits<int16_t>::min()
-     || value > std::numeric_limits<int16_t>::max()) return false;
-
-    result = (int16_t)value;
-    return true;
+    return fast_string2int<int16_t, uint16_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2int32(const char* source, int32_t& result, uint8_t converted_length, bool ignored_zero)
@@ -445,15 +362,7 @@ bool CStringUtils::string2int32(const char* source, int32_t& result, uint8_t con
 
 bool CStringUtils::string2int(const char* source, int32_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    if (NULL == source) return false;
-
-    long value;
-    if (!fast_string2int<long>(source, value, sizeof("-2147483648")-1, converted_length, ignored_zero)) return false;
-    if ((value < std::numeric_limits<int32_t>::min())
-     || (value > std::numeric_limits<int32_t>::max()))  return false;
-
-    result = (int32_t)value;
-    return true;
+    return fast_string2int<int32_t, uint32_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2int64(const char* source, int64_t& result, uint8_t converted_length, bool ignored_zero)
@@ -463,11 +372,7 @@ bool CStringUtils::string2int64(const char* source, int64_t& result, uint8_t con
 
 bool CStringUtils::string2int(const char* source, int64_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    long long value;
-    if (!fast_string2int<long long>(source, value, sizeof("-9223372036854775808")-1, converted_length, ignored_zero)) return false;
-
-    result = (int64_t)value;
-    return true;
+    return fast_string2int<int64_t, uint64_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2time_t(const char* source, time_t& result, uint8_t converted_length, bool ignored_zero)
@@ -521,12 +426,7 @@ bool CStringUtils::string2uint8(const char* source, uint8_t& result, uint8_t con
 
 bool CStringUtils::string2int(const char* source, uint8_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    uint16_t value = 0;
-    if (!string2uint16(source, value, converted_length, ignored_zero)) return false;
-    if (value > std::numeric_limits<uint8_t>::max()) return false;
-
-    result = (uint8_t)value;
-    return true;
+    return fast_string2int<uint8_t, uint8_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2uint16(const char* source, uint16_t& result, uint8_t converted_length, bool ignored_zero)
@@ -536,12 +436,7 @@ bool CStringUtils::string2uint16(const char* source, uint16_t& result, uint8_t c
 
 bool CStringUtils::string2int(const char* source, uint16_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    uint32_t value = 0;
-    if (!string2uint32(source, value, converted_length, ignored_zero)) return false;
-    if (value > std::numeric_limits<uint16_t>::max()) return false;
-
-    result = (uint16_t)value;
-    return true;
+    return fast_string2int<uint16_t, uint16_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2uint32(const char* source, uint32_t& result, uint8_t converted_length, bool ignored_zero)
@@ -551,11 +446,7 @@ bool CStringUtils::string2uint32(const char* source, uint32_t& result, uint8_t c
 
 bool CStringUtils::string2int(const char* source, uint32_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    unsigned long value;
-    if (!fast_string2int<unsigned long>(source, value, sizeof("4294967295")-1, converted_length, ignored_zero)) return false;
-
-    result = (uint32_t)value;
-    return true;
+    return fast_string2int<uint32_t, uint32_t>(source, result, converted_length, ignored_zero);
 }
 
 bool CStringUtils::string2uint64(const char* source, uint64_t& result, uint8_t converted_length, bool ignored_zero)
@@ -565,11 +456,7 @@ bool CStringUtils::string2uint64(const char* source, uint64_t& result, uint8_t c
 
 bool CStringUtils::string2int(const char* source, uint64_t& result, uint8_t converted_length, bool ignored_zero)
 {
-    unsigned long long value;
-    if (!fast_string2int<unsigned long long>(source, value, sizeof("18446744073709551615")-1, converted_length, ignored_zero)) return false;
-
-    result = (uint64_t)value;
-    return true;
+    return fast_string2int<uint64_t, uint64_t>(source, result, converted_length, ignored_zero);
 }
 
 std::string CStringUtils::int16_tostring(int16_t source)
@@ -577,17 +464,10 @@ std::string CStringUtils::int16_tostring(int16_t source)
     return int_tostring(source);
 }
 
-// #include <string>
-// std::to_string() throw (std::bad_alloc);
-// std::stoi() throw (std::invalid_argument,std::out_of_range)
-// std::stoul() throw (std::invalid_argument,std::out_of_range)
 std::string CStringUtils::int_tostring(int16_t source)
 {
-    // # define UINT16_MAX             (65535)
-    // # define INT16_MAX              (32767)
-    char str[sizeof("065535")]; // 0xFFFF
-    snprintf(str, sizeof(str), "%d", (int)source);
-    return str;
+    char str[sizeof("-9223372036854775808")];
+    return std::string(str, int64_toa(source, str));
 }
 
 std::string CStringUtils::int32_tostring(int32_t source)
@@ -597,11 +477,8 @@ std::string CStringUtils::int32_tostring(int32_t source)
 
 std::string CStringUtils::int_tostring(int32_t source)
 {
-    // # define UINT32_MAX             (4294967295U)
-    // # define INT32_MAX              (2147483647)
-    char str[sizeof("04294967295")]; // 0xFFFFFFFF
-    snprintf(str, sizeof(str), "%d", source);
-    return str;
+    char str[sizeof("-9223372036854775808")];
+    return std::string(str, int64_toa(source, str));
 }
 
 std::string CStringUtils::int64_tostring(int64_t source)
@@ -611,14 +488,8 @@ std::string CStringUtils::int64_tostring(int64_t source)
 
 std::string CStringUtils::int_tostring(int64_t source)
 {
-    char str[sizeof("018446744073709551615")]; // 0xFFFFFFFFFFFFFFFF
-    snprintf(str, sizeof(str), "%" PRId64, source);
-//#if __WORDSIZE==64
-//    snprintf(str, sizeof(str), "%ld", source);
-//#else
-//    snprintf(str, sizeof(str), "%lld", source);
-//#endif
-    return str;
+    char str[sizeof("-9223372036854775808")];
+    return std::string(str, int64_toa(source, str));
 }
 
 std::string CStringUtils::uint16_tostring(uint16_t source)
@@ -628,11 +499,8 @@ std::string CStringUtils::uint16_tostring(uint16_t source)
 
 std::string CStringUtils::int_tostring(uint16_t source)
 {
-    // # define INT16_MAX              (32767)
-    // # define UINT16_MAX             (65535)
-    char str[sizeof("065535")]; // 0xFFFF
-    snprintf(str, sizeof(str), "%d", (int)source);
-    return str;
+    char str[sizeof("-9223372036854775808")];
+    return std::string(str, uint64_toa(source, str));
 }
 
 std::string CStringUtils::uint32_tostring(uint32_t source)
@@ -642,10 +510,8 @@ std::string CStringUtils::uint32_tostring(uint32_t source)
 
 std::string CStringUtils::int_tostring(uint32_t source)
 {
-    // # define UINT32_MAX             (4294967295U)
-    char str[sizeof("04294967295")]; // 0xFFFFFFFF
-    snprintf(str, sizeof(str), "%u", source);
-    return str;
+    char str[sizeof("-9223372036854775808")];
+    return std::string(str, uint64_toa(source, str));
 }
 
 std::string CStringUtils::uint64_tostring(uint64_t source)
@@ -655,16 +521,82 @@ std::string CStringUtils::uint64_tostring(uint64_t source)
 
 std::string CStringUtils::int_tostring(uint64_t source)
 {
-    // # define UINT64_MAX             (__UINT64_C(18446744073709551615))
-    char str[sizeof("018446744073709551615")]; // 0xFFFFFFFFFFFFFFFF
-    snprintf(str, sizeof(str), "%" PRId64, source);
+    char str[sizeof("-9223372036854775808")];
+    return std::string(str, uint64_toa(source, str));
+}
 
-//#if __WORDSIZE==64
-//    snprintf(str, sizeof(str), "%lu", source);
-//#else
-//    snprintf(str, sizeof(str), "%llu", source);
-//#endif
-    return str;
+int CStringUtils::uint64_toa(uint64_t source, char* buffer)
+{
+    static const char digits[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    // 先计算位数，再从低位向高位填写
+    int length = 1;
+    for (uint64_t n=source; n>=10; n/=10)
+        ++length;
+
+    char* iter = buffer + length;
+    while (source >= 100)
+    {
+        const uint32_t i = static_cast<uint32_t>(source % 100) * 2;
+        source /= 100;
+        *--iter = digits[i+1];
+        *--iter = digits[i];
+    }
+    if (source >= 10)
+    {
+        const uint32_t i = static_cast<uint32_t>(source) * 2;
+        *--iter = digits[i+1];
+        *--iter = digits[i];
+    }
+    else
+    {
+        *--iter = static_cast<char>('0' + source);
+    }
+
+    return length;
+}
+
+int CStringUtils::int64_toa(int64_t source, char* buffer)
+{
+    if (source >= 0)
+        return uint64_toa(static_cast<uint64_t>(source), buffer);
+
+    // 以无符号取反，避免INT64_MIN取反溢出
+    *buffer = '-';
+    return 1 + uint64_toa(uint64_t(0) - static_cast<uint64_t>(source), buffer+1);
+}
+
+int CStringUtils::double_toa(double source, char* buffer)
+{
+#if MOOON_HAVE_TO_CHARS == 1
+    return static_cast<int>(std::to_chars(buffer, buffer+DOUBLE_TOA_BUFFER_SIZE, source).ptr - buffer);
+#else
+    // 从15位有效数字开始（15位总能精确表示），逐步增加到能还原为止，最多17位
+    int length = 0;
+    for (int precision=15; precision<=17; ++precision)
+    {
+        length = snprintf(buffer, DOUBLE_TOA_BUFFER_SIZE, "%.*g", precision, source);
+        if (strtod(buffer, NULL) == source)
+            break;
+    }
+    return length;
+#endif // MOOON_HAVE_TO_CHARS
+}
+
+std::string CStringUtils::double_tostring(double source)
+{
+    char str[DOUBLE_TOA_BUFFER_SIZE];
+    return std::string(str, double_toa(source, str));
 }
 
 char* CStringUtils::skip_spaces(char* buffer)
@@ -815,101 +747,51 @@ const char* CStringUtils::extract_filename(const char* filepath)
 // int asprintf(char **strp, const char *fmt, ...);
 std::string CStringUtils::format_string(const char* format, ...)
 {
-    size_t size = 4096;
-    std::string buffer(size, '\0');
-    char* buffer_p = const_cast<char*>(buffer.data());
-    int expected = 0;
+    // 先格式化到栈上的缓冲区，放得下时只需一次vsnprintf，
+    // 不再先构造并清零4096字节的std::string
+    char stack_buffer[1024];
     va_list ap;
 
-    while (true)
-    {
-        va_start(ap, format);
-        expected = vsnprintf(buffer_p, size, format, ap);
+    va_start(ap, format);
+    int expected = vsnprintf(stack_buffer, sizeof(stack_buffer), format, ap);
+    va_end(ap);
+    if (expected < 0)
+        return std::string();
+    if (expected < static_cast<int>(sizeof(stack_buffer)))
+        return std::string(stack_buffer, expected);
 
-        va_end(ap);
-        if (expected>-1 && expected<=static_cast<int>(size))
-        {
-            break;
-        }
-        else
-        {
-            /* The functions snprintf() and vsnprintf() do not write more than size bytes
-             * (including the terminating null byte ('\0')).
-             *
-             * If the output was truncated due to this limit then the return value is the number of characters
-             * (excluding the terminating null byte) which would have been written to the final
-             * string if enough space had been available.
-             *
-             * Thus, a return value of size or more means that the output was truncated.
-             *
-             * The glibc implementation of the functions snprintf() and vsnprintf() conforms to the C99 standard,
-             * that is, behaves as described above, since glibc version 2.1.
-             * Until glibc 2.0.6 they would return -1 when the output was truncated.
-             */
-
-            /* Else try again with more space. */
-            if (expected > -1)    /* glibc 2.1 */
-                size = static_cast<size_t>(expected + 1); /* precisely what is needed */
-            else           /* glibc 2.0 */
-                size *= 2;  /* twice the old size */
-
-            buffer.resize(size);
-            buffer_p = const_cast<char*>(buffer.data());
-        }
-    }
+    // 放不下时按vsnprintf返回的期望大小再格式化一次（vsnprintf总会写入结尾符，所以多分配一个字节）
+    std::string buffer(static_cast<size_t>(expected) + 1, '\0');
+    va_start(ap, format);
+    expected = vsnprintf(const_cast<char*>(buffer.data()), buffer.size(), format, ap);
+    va_end(ap);
 
-    // expected不包含字符串结尾符号，其值等于：strlen(buffer_p)
-    return std::string(buffer_p, expected>0?expected:0);
+    buffer.resize((expected > 0)? std::min(static_cast<size_t>(expected), buffer.size()-1): 0);
+    return buffer;
 }
 
 bool CStringUtils::is_numeric_string(const char* str, bool enable_float)
 {
-    const char* p = str;
-    bool found_dot = false;
+    const size_t size = strlen(str);
+    const size_t digits = CStringSimd::count_leading_digits(str, size);
+    if (digits == size)
+        return true;
 
-    while (*p != '\0')
-    {
-        if (!(*p >= '0' && *p <= '9'))
-        {
-            if (*p != '.')
-            {
-                return false;
-            }
-            else if (!enable_float)
-            {
-                // 不允许小数
-                return false;
-            }
-            else // 可能是小数
-            {
-                if (found_dot) // 小数只会有一个点
-                    return false;
-                if (p == str) // 小数点不能为第一个字符，即不允许：“.2017”这样的小数
-                    return false;
-
-                found_dot = true;
-            }
-        }
-
-        ++p;
-    }
+    // 不允许小数，或不是小数点
+    if (!enable_float || (str[digits] != '.'))
+        return false;
+    // 小数点不能为第一个字符，即不允许：“.2017”这样的小数
+    if (0 == digits)
+        return false;
 
-    return true;
+    // 小数只会有一个点，小数点之后只能全为数字
+    const size_t remaining = size - digits - 1;
+    return CStringSimd::count_leading_digits(str+digits+1, remaining) == remaining;
 }
 
 bool CStringUtils::is_alphabetic_string(const char* str)
 {
-    const char* p = str;
-
-    while (*p != '\0')
-    {
-        if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')))
-            return false;
-
-        ++p;
-    }
-
-    return true;
+    return CStringSimd::is_alphabetic(str, strlen(str));
 }
 
 bool CStringUtils::is_variable_string(const char* str)
@@ -1057,31 +939,9 @@ std::string CStringUtils::replace_suffix(const std::string& filepath, const std:
 
 std::string CStringUtils::to_hex(const std::string& source, bool lowercase)
 {
-    static unsigned char lower_hex_table[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-    static unsigned char upper_hex_table[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    std::string hex;
-    hex.resize(source.size()*2);
-
-    char* hex_p = const_cast<char*>(hex.data());
-    for (std::string::size_type i=0; i<source.size(); ++i)
-    {
-        unsigned char c = source[i];
-
-        if (lowercase)
-        {
-            hex_p[0] = lower_hex_table[(c >> 4) & 0x0F];
-            hex_p[1] = lower_hex_table[c & 0x0F];
-        }
-        else
-        {
-            hex_p[0] = upper_hex_table[(c >> 4) & 0x0F];
-            hex_p[1] = upper_hex_table[c & 0x0F];
-        }
-
-        hex_p += 2;
-    }
-
-    *hex_p = '\0';
+    std::string hex(source.size()*2, '\0');
+    if (!source.empty())
+        CStringSimd::to_hex(reinterpret_cast<const unsigned char*>(source.data()), source.size(), &hex[0], lowercase);
     return hex;
 }
 
@@ -1094,49 +954,10 @@ std::string CStringUtils::encode_url(const std::string& url, bool space2plus)
 
 std::string CStringUtils::encode_url(const char* url, size_t url_length, bool space2plus)
 {
-    static char hex[] = "0123456789ABCDEF";
-    std::string result(url_length*3+1, '\0');
-
-    int i = 0;
-    while (*url != '\0')
-    {
-        char c = *url++;
-
-        if (' ' == c)
-        {
-            if (space2plus)
-            {
-                result[i++] = '+';
-            }
-            else
-            {
-                // 新标准将空格替换为加号+
-                result[i+0] = '%';
-                result[i+1] = '2';
-                result[i+2] = '0';
-                i += 3;
-            }
-        }
-        else if ((c >= '0' && c <= '9') ||
-                 (c >= 'a' && c <= 'z') ||
-                 (c >= 'A' && c <= 'Z') ||
-                 (c == '-') || (c == '_') ||
-                 (c == '.') || (c == '~'))
-        {
-            // RFC 3986标准定义的未保留字符 (2005年1月)
-            result[i++] = c;
-        }
-        else
-        {
-            // 有符号的c值可能是负数
-            result[i+0] = '%';
-            result[i+1] = hex[static_cast<unsigned char>(c) / 16];
-            result[i+2] = hex[static_cast<unsigned char>(c) % 16];
-            i += 3;
-        }
-    }
-
-    result.resize(i);
+    // 新标准将空格替换为%20，RFC 3986标准定义的未保留字符不编码
+    std::string result(url_length*3, '\0');
+    if (url_length > 0)
+        result.resize(CCodec::url_encode(url, url_length, &result[0], space2plus));
     return result;
 }
 
@@ -1147,43 +968,9 @@ std::string CStringUtils::decode_url(const std::string& encoded_url)
 
 std::string CStringUtils::decode_url(const char* encoded_url, size_t encoded_url_length)
 {
-    std::string result(encoded_url_length+1, '\0');
-
-    int i = 0;
-    while (*encoded_url != '\0')
-    {
-        char c = *encoded_url++;
-
-        if (c == '+')
-        {
-            result[i++] = ' ';
-        }
-        else if (c != '%')
-        {
-            result[i++] = c;
-        }
-        else
-        {
-            if (!isxdigit(encoded_url[0]) ||
-                !isxdigit(encoded_url[1]))
-            {
-                result[i++] = '%';
-            }
-            else
-            {
-                char hex[3];
-                hex[0] = encoded_url[0];
-                hex[1] = encoded_url[1];
-                hex[2] = '\0';
-
-                char x = strtol(hex, NULL, 16);
-                result[i++] = x;
-                encoded_url += 2;
-            }
-        }
-    }
-
-    result.resize(i);
+    std::string result(encoded_url, encoded_url_length);
+    if (encoded_url_length > 0)
+        result.resize(CCodec::url_decode(result.data(), result.size(), &result[0]));
     return result;
 }
 
@@ -1222,7 +1009,10 @@ unsigned char CStringUtils::hex2char(const std::string& hex)
 
     for (int i=0; i<std::min<int>(hex.size(), 2); ++i)
     {
-        unsigned char c1 = toupper(hex[i]); // ctype.h
+        // 同toupper，但不查locale表
+        unsigned char c1 = static_cast<unsigned char>(hex[i]);
+        if (static_cast<unsigned char>(c1 - 'a') < 26)
+            c1 ^= 0x20;
         unsigned char c2 = (c1 >= 'A') ? (c1 - ('A' - 10)) : (c1 - '0');
         (c <<= 4) += c2;
     }
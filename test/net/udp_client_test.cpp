@@ -4,11 +4,40 @@
 #include "mooon/net/udp_socket.h"
 MOOON_NAMESPACE_USE
 
+// 以sendmmsg批量发送count个消息，配合“udp_server_test batch”压测
+static void batch_send(net::CUdpSocket* udp_socket, uint64_t count)
+{
+    net::CUdpMessageArena arena(64, 64);
+    struct sockaddr_in to_addr;
+    char message[64];
+
+    memset(&to_addr, 0, sizeof(to_addr));
+    to_addr.sin_family = AF_INET;
+    to_addr.sin_port = htons(2015);
+    to_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    memset(message, 'm', sizeof(message));
+
+    for (uint64_t sent=0; sent<count;)
+    {
+        arena.clear();
+        while ((sent+arena.get_number() < count) && arena.add(message, sizeof(message), to_addr));
+
+        for (uint32_t offset=0; offset<arena.get_number();)
+        {
+            int number = udp_socket->send_batch(&arena, offset);
+            if (number > 0)
+                offset += number;
+        }
+        sent += arena.get_number();
+    }
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    if ((argc != 2) && !((3 == argc) && (0 == strcmp(argv[1], "-b"))))
     {
         fprintf(stderr, "Usage: udp_client_test message\n");
+        fprintf(stderr, "       udp_client_test -b count\n");
         exit(1);
     }
 
@@ -20,6 +49,12 @@ int main(int argc, char* argv[])
         udp_socket.listen(port);
         printf("udp listen on: %d\n", port);
 
+        if (3 == argc)
+        {
+            batch_send(&udp_socket, strtoull(argv[2], NULL, 10));
+            return 0;
+        }
+
         udp_socket.send_to(argv[1], strlen(argv[1])+1, "127.0.0.1", 2015);
 
         char buffer[548+1]; // 1472
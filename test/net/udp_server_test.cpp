@@ -2,8 +2,42 @@
 // Author: yijian
 // Date: 2015/4/28
 #include "mooon/net/udp_socket.h"
+#include <time.h>
 MOOON_NAMESPACE_USE
 
+// 批量吞吐模式：以recvmmsg批量接收，不回应答，每秒输出一次收到的消息数
+// 可用“udp_client_test -b 消息数”压测
+static void batch_receive(net::CUdpSocket* udp_socket, bool gro)
+{
+    gro = gro && udp_socket->enable_gro(true);
+    net::CUdpMessageArena arena(64, gro? 65535: 1472);
+    uint64_t messages = 0, syscalls = 0;
+    time_t last = time(NULL);
+
+    printf("batch mode, gro: %s\n", gro? "on": "off");
+    while (true)
+    {
+        int number = udp_socket->receive_batch(&arena);
+        ++syscalls;
+
+        for (int i=0; i<number; ++i)
+        {
+            // GRO合并的消息按分段大小还原成多个
+            uint16_t segment_size = arena.get_segment_size(i);
+            messages += (0 == segment_size)? 1: (arena.get_size(i)+segment_size-1) / segment_size;
+        }
+
+        time_t now = time(NULL);
+        if (now != last)
+        {
+            printf("%" PRIu64 " pps, %" PRIu64 " syscalls\n", messages / (now-last), syscalls / (now-last));
+            messages = 0;
+            syscalls = 0;
+            last = now;
+        }
+    }
+}
+
 int main(int argc, char* argv[])
 {
     try
@@ -14,6 +48,13 @@ int main(int argc, char* argv[])
         udp_socket.listen(port);
         printf("udp listen on: %d\n", port);
 
+        // udp_server_test batch [gro]
+        if ((argc > 1) && (0 == strcmp(argv[1], "batch")))
+        {
+            batch_receive(&udp_socket, (argc > 2) && (0 == strcmp(argv[2], "gro")));
+            return 0;
+        }
+
         while (true)
         {
             char buffer[548+1]; // 1472
@@ -0,0 +1,166 @@
+#include "mooon/net/event_loop.h"
+#include "mooon/net/listener.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+using namespace mooon;
+
+#define CLIENT_NUMBER 50
+
+static int connect_to(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (-1 == connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static uint16_t listen_loopback(net::CListener* listener)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    listener->listen(net::ip_address_t("127.0.0.1"), 0, true);
+    (void)getsockname(listener->get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    return ntohs(addr.sin_port);
+}
+
+// 一次可读取完accept队列，接受的连接已是非阻塞和FD_CLOEXEC的
+static bool test_batch(std::vector<int>* accepted_fds, std::vector<int>* client_fds)
+{
+    net::CListener listener;
+    listener.set_backlog(64);
+    const uint16_t port = listen_loopback(&listener);
+
+    for (int i=0; i<CLIENT_NUMBER; ++i)
+        client_fds->push_back(connect_to(port));
+
+    uint32_t queue_length = 0, max_length = 0;
+    if (!listener.get_queue_info(&queue_length, &max_length))
+        return false;
+    printf("queue: %u/%u\n", queue_length, max_length);
+    if ((CLIENT_NUMBER != queue_length) || (64 != max_length))
+        return false;
+
+    net::accepted_t accepted_array[32];
+    int numbers[3];
+    for (int k=0; k<3; ++k)
+    {
+        numbers[k] = listener.accept_batch(accepted_array, 32);
+        for (int i=0; i<numbers[k]; ++i)
+        {
+            const int fd = accepted_array[i].fd;
+            if (!(fcntl(fd, F_GETFL) & O_NONBLOCK) || !(fcntl(fd, F_GETFD) & FD_CLOEXEC)
+             || (accepted_array[i].peer_ip.to_string() != "127.0.0.1"))
+                return false;
+            accepted_fds->push_back(fd);
+        }
+    }
+
+    printf("batch: %d, %d, %d\n", numbers[0], numbers[1], numbers[2]);
+    return (32 == numbers[0]) && (CLIENT_NUMBER-32 == numbers[1]) && (0 == numbers[2]);
+}
+
+// 有数据到达后才可accept
+static bool test_defer_accept()
+{
+    net::CListener listener;
+    const uint16_t port = listen_loopback(&listener);
+    listener.set_defer_accept(1);
+
+    net::accepted_t accepted;
+    int fd = connect_to(port);
+    sys::CUtils::millisleep(50);
+    const int before = listener.accept_batch(&accepted, 1);
+    if (write(fd, "GET", 3) != 3)
+        return false;
+
+    struct pollfd fds = { listener.get_fd(), POLLIN, 0 };
+    (void)poll(&fds, 1, 1000);
+    const int after = listener.accept_batch(&accepted, 1);
+    char buffer[3];
+    const bool ok = (1 == after) && (3 == read(accepted.fd, buffer, sizeof(buffer)));
+    printf("defer accept: %d before data, %d after\n", before, after);
+    close(fd);
+    if (1 == after)
+        close(accepted.fd);
+    return (0 == before) && ok;
+}
+
+static bool test_stats()
+{
+    net::listen_stats_t stats;
+    if (!net::CListener::get_listen_stats(&stats))
+        return false;
+    printf("stats: overflows=%" PRIu64", drops=%" PRIu64", syncookies=%d, sent=%" PRIu64"\n",
+           stats.listen_overflows, stats.listen_drops, stats.syncookies, stats.syncookies_sent);
+    return stats.listen_drops >= stats.listen_overflows;
+}
+
+class CConnection: public net::CEpollable
+{
+public:
+    CConnection(int fd) { set_fd(fd); }
+};
+
+// 批量分配给Reactor，每个循环只投递一个任务，对端未关闭，所以连接不会因可读而被关闭
+static bool test_assign(const std::vector<int>& accepted_fds)
+{
+    net::CReactorPool reactor_pool;
+    reactor_pool.create(3, 100, false);
+
+    std::vector<net::CEpollable*> epollables;
+    for (std::vector<int>::size_type i=0; i<accepted_fds.size(); ++i)
+    {
+        net::CEpollable* epollable = new CConnection(accepted_fds[i]);
+        epollable->inc_refcount();
+        epollables.push_back(epollable);
+    }
+    reactor_pool.assign(&epollables[0], static_cast<uint32_t>(epollables.size()), EPOLLIN);
+    sys::CUtils::millisleep(100);
+
+    uint32_t numbers[3];
+    for (uint16_t i=0; i<3; ++i)
+        numbers[i] = reactor_pool.get_loop(i)->get_epollable_number();
+    reactor_pool.destroy();
+    printf("assign: %u, %u, %u\n", numbers[0], numbers[1], numbers[2]);
+    return (numbers[0] + numbers[1] + numbers[2] == epollables.size()) && (numbers[0] >= 16) && (numbers[2] >= 16);
+}
+
+int main()
+{
+    try
+    {
+        std::vector<int> accepted_fds;
+        std::vector<int> client_fds;
+        if (!test_batch(&accepted_fds, &client_fds))
+            return 1;
+        if (!test_defer_accept())
+            return 1;
+        if (!test_stats())
+            return 1;
+        if (!test_assign(accepted_fds))
+            return 1;
+        for (std::vector<int>::size_type i=0; i<client_fds.size(); ++i)
+            close(client_fds[i]);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("accept batch ok\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "mooon/net/backend_selector.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/exception.h"
+#include <inttypes.h>
+#include <stdio.h>
+using namespace mooon;
+
+// 慢的后端只偶尔被选中
+static bool test_latency()
+{
+    net::backend_policy_t policy;
+    policy.outlier_interval_milliseconds = 0;
+    net::CBackendSelector selector(4, policy);
+    uint32_t selected[4] = { 0 };
+
+    for (int i=0; i<10000; ++i)
+    {
+        const int index = selector.select();
+        if (-1 == index)
+            return false;
+        ++selected[index];
+        selector.report(index, true, (3 == index)? 20000000: 1000000);
+    }
+
+    printf("latency: %u %u %u %u\n", selected[0], selected[1], selected[2], selected[3]);
+    if (selected[3] > 500)
+        return false;
+    for (int i=0; i<3; ++i)
+    {
+        if (selected[i] < 2500)
+            return false;
+    }
+    return true;
+}
+
+// 延迟远高于中位数的后端被剔除
+static bool test_outlier()
+{
+    net::backend_policy_t policy;
+    policy.outlier_interval_milliseconds = 1;
+    net::CBackendSelector selector(4, policy);
+    net::backend_stats_t stats;
+
+    for (int round=0; round<2; ++round)
+    {
+        for (uint32_t i=0; i<4; ++i)
+            selector.report(i, true, (3 == i)? 20000000: 1000000);
+        sys::CUtils::millisleep(2);
+    }
+    selector.report(0, true, 1000000);
+
+    selector.get_stats(3, &stats);
+    printf("outlier: ejected=%d ewma=%" PRIu64"ns\n", stats.ejected, stats.ewma_nanoseconds);
+    if (!stats.ejected)
+        return false;
+    for (int i=0; i<100; ++i)
+    {
+        const int index = selector.select();
+        if ((-1 == index) || (3 == index))
+            return false;
+        selector.report(index, true, 1000000);
+    }
+
+    selector.get_stats(0, &stats);
+    return !stats.ejected;
+}
+
+// 连续失败后熔断，到期后只放行一个探测，探测失败则加倍熔断
+static bool test_breaker()
+{
+    net::backend_policy_t policy;
+    policy.failure_threshold = 3;
+    policy.open_milliseconds = 20;
+    policy.max_open_milliseconds = 40;
+    policy.outlier_interval_milliseconds = 0;
+    net::CBackendSelector selector(2, policy);
+    net::backend_stats_t stats;
+
+    for (int i=0; i<3; ++i)
+        selector.report(0, false, 0);
+    selector.get_stats(0, &stats);
+    if ((net::breaker_open != stats.state) || (3 != stats.consecutive_failures))
+        return false;
+    for (int i=0; i<100; ++i)
+    {
+        const int index = selector.select();
+        if (index != 1)
+            return false;
+        selector.report(index, true, 1000000);
+    }
+
+    // 没有样本且没有在途请求的后端代价最低，到期后第一个被选中的就是探测
+    sys::CUtils::millisleep(25);
+    if (0 != selector.select())
+        return false;
+    for (int i=0; i<10; ++i)
+    {
+        const int index = selector.select();
+        if (index != 1)
+            return false;
+        selector.report(index, true, 1000000);
+    }
+    selector.report(0, false, 0);
+    selector.get_stats(0, &stats);
+    if (net::breaker_open != stats.state)
+        return false;
+
+    sys::CUtils::millisleep(25);
+    if (0 == selector.select())
+        return false;
+    sys::CUtils::millisleep(20);
+    if (0 != selector.select())
+        return false;
+    selector.report(0, true, 1000000);
+    selector.get_stats(0, &stats);
+    printf("breaker: state=%d failures=%u\n", stats.state, stats.consecutive_failures);
+    return (net::breaker_closed == stats.state) && (0 == stats.consecutive_failures);
+}
+
+struct OnlySecond
+{
+    bool operator ()(uint32_t index) const { return 1 == index; }
+};
+
+static bool test_usable()
+{
+    net::CBackendSelector selector(3);
+    for (int i=0; i<10; ++i)
+    {
+        const int index = selector.select(OnlySecond());
+        if (index != 1)
+            return false;
+        selector.cancel(index);
+    }
+
+    net::backend_stats_t stats;
+    selector.get_stats(1, &stats);
+    if ((0 != stats.outstanding) || (10 != stats.selected_number))
+        return false;
+
+    for (uint32_t i=0; i<3; ++i)
+        for (int j=0; j<5; ++j)
+            selector.report(i, false, 0);
+    return -1 == selector.select();
+}
+
+int main()
+{
+    try
+    {
+        net::CBackendSelector selector(0);
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+
+    if (!test_latency())
+        return 1;
+    if (!test_outlier())
+        return 1;
+    if (!test_breaker())
+        return 1;
+    if (!test_usable())
+        return 1;
+
+    printf("backend selector ok\n");
+    return 0;
+}
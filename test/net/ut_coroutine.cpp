@@ -0,0 +1,205 @@
+#include "mooon/net/coroutine.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/string_utils.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string>
+using namespace mooon;
+
+#if MOOON_HAVE_COROUTINE
+#define SESSION_NUMBER 1000
+
+static net::CTask<int> add(int a, int b)
+{
+    co_return a + b;
+}
+
+static net::CTask<int> fail(int errcode)
+{
+    THROW_SYSCALL_EXCEPTION(NULL, errcode, "fail");
+    co_return 0;
+}
+
+static net::CTask<void> compute(int* result, int* errcode)
+{
+    *result = co_await add(1, 2) * 10;
+
+    std::vector<net::CTask<int> > tasks;
+    for (int i=0; i<10; ++i)
+        tasks.push_back(add(i, i));
+    std::vector<int> values = co_await net::when_all(std::move(tasks));
+    for (std::vector<int>::size_type i=0; i<values.size(); ++i)
+        *result += values[i];
+
+    try
+    {
+        tasks.clear();
+        tasks.push_back(add(1, 1));
+        tasks.push_back(fail(EPERM));
+        tasks.push_back(fail(ENOENT));
+        (void)co_await net::when_all(std::move(tasks));
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        *errcode = ex.errcode(); // 第一个异常
+    }
+}
+
+// 不需要事件循环时同步完成
+static bool test_task()
+{
+    int result = 0, errcode = 0;
+    net::CTask<void> task = compute(&result, &errcode);
+    if (task.is_done() || (result != 0))
+        return false; // 惰性的，resume之前不开始
+    task.resume();
+    printf("task: result=%d, errcode=%d\n", result, errcode);
+    return task.is_done() && (30 + 90 == result) && (EPERM == errcode);
+}
+
+struct TestContext
+{
+    net::CEventLoop* event_loop;
+    uint16_t port;
+    int listen_fd;
+    int ok_number;
+    uint64_t slept_milliseconds;
+    int timeout_errcode;
+    sys::CLock lock;
+    sys::CEvent event;
+    bool finished;
+};
+
+static net::CTask<void> echo_session(net::CEventLoop* event_loop, int fd)
+{
+    net::CAsyncSocket socket(event_loop, fd);
+    char buffer[1024];
+    for (;;)
+    {
+        const ssize_t bytes = co_await socket.receive(buffer, sizeof(buffer));
+        if (0 == bytes)
+            break;
+        co_await socket.full_send(buffer, bytes);
+    }
+}
+
+static net::CTask<void> accept_loop(TestContext* context)
+{
+    net::CAsyncSocket listener(context->event_loop, context->listen_fd);
+    for (int i=0; i<SESSION_NUMBER+1; ++i)
+    {
+        const int fd = static_cast<int>(co_await listener.accept());
+        net::spawn(context->event_loop, echo_session(context->event_loop, fd));
+    }
+}
+
+static net::CTask<int> client_session(TestContext* context, int index)
+{
+    net::CAsyncSocket socket(context->event_loop);
+    co_await socket.connect(net::ip_node_t(context->port, net::ip_address_t("127.0.0.1")), 1000);
+
+    std::string request = utils::CStringUtils::int_tostring(index) + std::string(100, 'x');
+    std::string response(request.size(), '\0');
+    co_await socket.full_send(request.data(), request.size());
+    const bool ok = co_await socket.full_receive(&response[0], response.size(), 1000);
+    co_return (ok && (request == response))? 1: 0;
+}
+
+static net::CTask<void> run_test(TestContext* context)
+{
+    // 所有会话并发运行在同一线程中
+    std::vector<net::CTask<int> > sessions;
+    for (int i=0; i<SESSION_NUMBER; ++i)
+        sessions.push_back(client_session(context, i));
+    std::vector<int> results = co_await net::when_all(std::move(sessions));
+    for (std::vector<int>::size_type i=0; i<results.size(); ++i)
+        context->ok_number += results[i];
+
+    const uint64_t start = net::CEventLoop::get_monotonic_milliseconds();
+    co_await net::async_sleep(context->event_loop, 50);
+    context->slept_milliseconds = net::CEventLoop::get_monotonic_milliseconds() - start;
+
+    // 对端不回应时receive超时
+    net::CAsyncSocket socket(context->event_loop);
+    co_await socket.connect(net::ip_node_t(context->port, net::ip_address_t("127.0.0.1")));
+    try
+    {
+        char buffer[16];
+        (void)co_await socket.receive(buffer, sizeof(buffer), 50);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        context->timeout_errcode = ex.errcode();
+    }
+
+    sys::LockHelper<sys::CLock> lock_helper(context->lock);
+    context->finished = true;
+    context->event.signal();
+}
+
+static bool test_event_loop()
+{
+    TestContext context;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    context.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if ((-1 == bind(context.listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(context.listen_fd, 1024))
+     || (-1 == getsockname(context.listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+        return false;
+
+    net::CReactorPool reactor_pool;
+    reactor_pool.create(1, 100, false);
+    context.event_loop = reactor_pool.get_loop(0);
+    context.port = ntohs(addr.sin_port);
+    context.ok_number = 0;
+    context.slept_milliseconds = 0;
+    context.timeout_errcode = 0;
+    context.finished = false;
+
+    const uint64_t start = net::CEventLoop::get_monotonic_milliseconds();
+    net::spawn(context.event_loop, accept_loop(&context));
+    net::spawn(context.event_loop, run_test(&context));
+    {
+        sys::LockHelper<sys::CLock> lock_helper(context.lock);
+        while (!context.finished)
+            (void)context.event.timed_wait(context.lock, 10000);
+    }
+    const uint64_t milliseconds = net::CEventLoop::get_monotonic_milliseconds() - start;
+    reactor_pool.destroy();
+
+    printf("event loop: %d/%d sessions ok in %" PRIu64"ms, slept %" PRIu64"ms, timeout errcode=%d\n",
+           context.ok_number, SESSION_NUMBER, milliseconds, context.slept_milliseconds, context.timeout_errcode);
+    return (SESSION_NUMBER == context.ok_number) && (context.slept_milliseconds >= 50) && (ETIMEDOUT == context.timeout_errcode);
+}
+
+int main()
+{
+    try
+    {
+        if (!test_task())
+            return 1;
+        if (!test_event_loop())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("coroutine ok\n");
+    return 0;
+}
+#else
+int main()
+{
+    printf("coroutine not supported\n");
+    return 0;
+}
+#endif // MOOON_HAVE_COROUTINE
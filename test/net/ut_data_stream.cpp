@@ -0,0 +1,194 @@
+#include "mooon/net/data_stream.h"
+#include "mooon/sys/clock.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <vector>
+using namespace mooon;
+
+// 固定大小的写满后失败，读取的位置不要求对齐
+static bool test_fixed(bool reverse_bytes)
+{
+    net::CStreamWriter writer(15, reverse_bytes);
+    if (!writer.write(static_cast<uint8_t>(1)) || !writer.write(static_cast<uint32_t>(0x01020304))
+     || !writer.write(static_cast<uint64_t>(0x0102030405060708ULL)) || !writer.write("ab", 2))
+        return false;
+    if (writer.write(static_cast<uint8_t>(2)) || (15 != writer.get_offset()))
+        return false;
+
+    net::CStreamReader reader(writer.get_buffer(), writer.get_offset(), reverse_bytes, false);
+    uint8_t a;
+    uint32_t b;
+    uint64_t c;
+    char d[2];
+    if (!reader.read(a) || !reader.read(b) || !reader.read(c) || !reader.read(d, 2) || reader.read(a))
+        return false;
+    if (reverse_bytes && (0x01 != static_cast<uint8_t>(writer.get_buffer()[1])))
+        return false;
+    return (1 == a) && (0x01020304 == b) && (0x0102030405060708ULL == c) && ('a' == d[0]) && ('b' == d[1]);
+}
+
+static bool test_varint(sys::CSlabMemPool* mem_pool)
+{
+    const uint64_t unsigned_values[] = { 0, 1, 127, 128, 300, 16383, 16384, UINT32_MAX, UINT64_MAX };
+    const int64_t signed_values[] = { 0, -1, 1, -64, 64, INT32_MIN, INT32_MAX, INT64_MIN, INT64_MAX };
+    const uint32_t expected_sizes[] = { 1, 1, 1, 2, 2, 2, 3, 5, 10 };
+    net::CStreamWriter writer(mem_pool, 4);
+
+    for (size_t i=0; i<sizeof(unsigned_values)/sizeof(unsigned_values[0]); ++i)
+    {
+        const uint32_t offset = writer.get_offset();
+        if (!writer.write_varint(unsigned_values[i]) || (writer.get_offset()-offset != expected_sizes[i])
+         || (expected_sizes[i] != net::CStreamWriter::get_varint_size(unsigned_values[i])))
+            return false;
+    }
+    for (size_t i=0; i<sizeof(signed_values)/sizeof(signed_values[0]); ++i)
+    {
+        if (!writer.write_zigzag(signed_values[i]))
+            return false;
+    }
+    if (!writer.write_string(std::string("hello")) || !writer.write_string("", 0))
+        return false;
+    printf("varint: %u bytes, capacity %u\n", writer.get_offset(), writer.get_size());
+
+    net::CStreamReader reader(writer.get_buffer(), writer.get_offset(), false, false);
+    for (size_t i=0; i<sizeof(unsigned_values)/sizeof(unsigned_values[0]); ++i)
+    {
+        uint64_t value;
+        if (!reader.read_varint(value) || (value != unsigned_values[i]))
+            return false;
+    }
+    for (size_t i=0; i<sizeof(signed_values)/sizeof(signed_values[0]); ++i)
+    {
+        int64_t value;
+        if (!reader.read_zigzag(value) || (value != signed_values[i]))
+            return false;
+    }
+
+    std::string_view hello;
+    std::string empty("x");
+    if (!reader.read_string(hello) || ("hello" != hello) || !reader.read_string(empty) || !empty.empty())
+        return false;
+    if ((hello.data() < writer.get_buffer()) || (hello.data() >= writer.get_buffer()+writer.get_size()))
+        return false; // 不复制
+    return 0 == reader.get_remaining();
+}
+
+// 不完整或超出范围时失败，且不移动读位置
+static bool test_truncated()
+{
+    char data[16];
+    net::CStreamWriter writer(data, sizeof(data));
+    (void)writer.write_varint(UINT64_MAX);
+    (void)writer.write_varint(static_cast<uint64_t>(UINT32_MAX) + 1);
+    writer.detach(); // data不是new出来的
+
+    uint64_t u64;
+    uint32_t u32;
+    int32_t i32;
+    const char* str;
+    uint32_t size;
+    net::CStreamReader truncated(data, 9, false, false);
+    if (truncated.read_varint(u64) || (0 != truncated.get_offset()))
+        return false;
+
+    net::CStreamReader reader(data, 15, false, false);
+    if (!reader.read_varint(u64) || reader.read_varint(u32) || (10 != reader.get_offset()) || reader.read_zigzag(i32))
+        return false;
+
+    // 长度前缀大于剩余的数据
+    char message[] = { 5, 'a', 'b' };
+    net::CStreamReader string_reader(message, sizeof(message), false, false);
+    return !string_reader.read_string(str, size) && (0 == string_reader.get_offset());
+}
+
+static bool test_array(sys::CSlabMemPool* mem_pool)
+{
+    std::vector<uint32_t> values(100000);
+    for (size_t i=0; i<values.size(); ++i)
+        values[i] = static_cast<uint32_t>(i * 2654435761U);
+
+    net::CStreamWriter writer(mem_pool, 64, true);
+    if (!writer.write(static_cast<uint8_t>(7)) || !writer.write_array(&values[0], static_cast<uint32_t>(values.size())))
+        return false;
+
+    // 逐个反转和整体反转的结果一致
+    uint32_t first;
+    memcpy(&first, writer.get_buffer()+1+4, sizeof(first));
+    if (first != __builtin_bswap32(values[1]))
+        return false;
+
+    uint8_t head;
+    std::vector<uint32_t> result(values.size());
+    net::CStreamReader reader(writer.get_buffer(), writer.get_offset(), true, false);
+    if (!reader.read(head) || !reader.read_array(&result[0], static_cast<uint32_t>(result.size())) || (result != values))
+        return false;
+
+    const int rounds = 100;
+    uint64_t start = sys::CClock::get_nanoseconds();
+    for (int i=0; i<rounds; ++i)
+    {
+        writer.clear();
+        (void)writer.write_array(&values[0], static_cast<uint32_t>(values.size()));
+    }
+    const uint64_t bulk_ns = sys::CClock::get_nanoseconds() - start;
+    start = sys::CClock::get_nanoseconds();
+    for (int i=0; i<rounds; ++i)
+    {
+        writer.clear();
+        for (size_t j=0; j<values.size(); ++j)
+            (void)writer.write(values[j]);
+    }
+    const uint64_t each_ns = sys::CClock::get_nanoseconds() - start;
+    printf("array: bulk %.2fns, each %.2fns per element\n",
+           bulk_ns / static_cast<double>(rounds*values.size()), each_ns / static_cast<double>(rounds*values.size()));
+    return true;
+}
+
+// 整个数据流压缩后发送，解压后照常读取
+static bool test_compress(sys::CSlabMemPool* mem_pool)
+{
+    net::CStreamWriter writer(mem_pool, 64);
+    for (uint32_t i=0; i<1000; ++i)
+    {
+        if (!writer.write_varint(i) || !writer.write_string("repeated field value"))
+            return false;
+    }
+
+    std::string compressed, data;
+    writer.compress(utils::compression_gzip, &compressed);
+    utils::decompress_data(utils::compression_gzip, compressed.data(), compressed.size(), &data);
+    printf("compress: %u -> %zu bytes\n", writer.get_offset(), compressed.size());
+    if ((data.size() != writer.get_offset()) || (compressed.size() * 4 > data.size()))
+        return false;
+
+    net::CStreamReader reader(&data[0], static_cast<uint32_t>(data.size()), false, false);
+    for (uint32_t i=0; i<1000; ++i)
+    {
+        uint32_t value;
+        std::string str;
+        if (!reader.read_varint(value) || (value != i) || !reader.read_string(str) || (str != "repeated field value"))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    sys::CSlabMemPool mem_pool;
+    mem_pool.create(64, 4096, 100, 16);
+
+    if (!test_fixed(false) || !test_fixed(true))
+        return 1;
+    if (!test_varint(NULL) || !test_varint(&mem_pool))
+        return 1;
+    if (!test_truncated())
+        return 1;
+    if (!test_array(&mem_pool))
+        return 1;
+    if (!test_compress(&mem_pool))
+        return 1;
+
+    mem_pool.destroy();
+    printf("data stream ok\n");
+    return 0;
+}
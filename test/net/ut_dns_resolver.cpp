@@ -0,0 +1,143 @@
+#include "mooon/net/dns_resolver.h"
+#include "mooon/net/event_loop.h"
+#include "mooon/net/utils.h"
+#include "mooon/sys/utils.h"
+#include <inttypes.h>
+#include <stdio.h>
+using namespace mooon;
+
+// IPv6和IPv4交替，首选的地址族在前
+static bool test_happy_eyeballs()
+{
+    uint32_t ipv6[4] = { htonl(0x20010db8), 0, 0, htonl(1) };
+    net::ip_address_array_t ip_array;
+    ip_array.push_back(net::ip_address_t("10.0.0.1"));
+    ip_array.push_back(net::ip_address_t("10.0.0.2"));
+    ip_array.push_back(net::ip_address_t(ipv6));
+    ip_array.push_back(net::ip_address_t("10.0.0.3"));
+
+    net::CDnsResolver::sort_happy_eyeballs(&ip_array, true);
+    std::string order;
+    for (net::ip_address_array_t::size_type i=0; i<ip_array.size(); ++i)
+        order += ip_array[i].is_ipv6()? "6": "4";
+    printf("happy eyeballs: %s, first ipv4 %s\n", order.c_str(), ip_array[1].to_string().c_str());
+    return ("6444" == order) && ("10.0.0.1" == ip_array[1].to_string()) && ("10.0.0.3" == ip_array[3].to_string());
+}
+
+static bool test_cache()
+{
+    net::CDnsResolver resolver(200, 100, 1000, 0.5);
+    resolver.create(1);
+
+    net::ip_address_array_t ip_array;
+    std::string errinfo;
+    if (!resolver.resolve("127.0.0.2", &ip_array, &errinfo) || (ip_array.size() != 1) || (resolver.get_lookup_number() != 0))
+        return false; // IP不需要解析
+
+    if (!resolver.resolve("localhost", &ip_array, &errinfo) || ip_array.empty())
+        return false;
+    if (!resolver.resolve("localhost", &ip_array, &errinfo) || (1 != resolver.get_hit_number()) || (1 != resolver.get_miss_number()))
+        return false;
+
+    // 进入有效期的后一半时后台刷新，调用者立即得到缓存的结果
+    sys::CUtils::millisleep(120);
+    if (!resolver.resolve("localhost", &ip_array, &errinfo) || (1 != resolver.get_prefetch_number()))
+        return false;
+    sys::CUtils::millisleep(50);
+
+    // 失败的结果也被缓存
+    const bool ok = resolver.resolve("no-such-host.invalid", &ip_array, &errinfo);
+    std::string errinfo2;
+    const bool ok2 = resolver.resolve("no-such-host.invalid", &ip_array, &errinfo2);
+    printf("cache: hit=%" PRIu64", miss=%" PRIu64", prefetch=%" PRIu64", lookup=%" PRIu64", negative: %s\n",
+           resolver.get_hit_number(), resolver.get_miss_number(), resolver.get_prefetch_number(), resolver.get_lookup_number(), errinfo.c_str());
+    if (ok || ok2 || errinfo.empty() || (errinfo != errinfo2) || (3 != resolver.get_lookup_number()))
+        return false;
+
+    resolver.invalidate();
+    if (!resolver.resolve("localhost", &ip_array, &errinfo) || (4 != resolver.get_lookup_number()))
+        return false;
+    resolver.destroy();
+    return true;
+}
+
+class CResolveHandler: public net::IResolveHandler
+{
+public:
+    CResolveHandler(): in_loop_thread(false), ip_number(0), event_loop(NULL) {}
+
+private:
+    virtual void on_resolved(const std::string& hostname, const net::ip_address_array_t& ip_array, const std::string& errinfo)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(lock);
+        in_loop_thread = event_loop->in_loop_thread();
+        ip_number = static_cast<int>(ip_array.size());
+        event.signal();
+    }
+
+public:
+    sys::CLock lock;
+    sys::CEvent event;
+    bool in_loop_thread;
+    int ip_number;
+    net::CEventLoop* event_loop;
+};
+
+// 在事件循环线程中回调
+static bool test_async()
+{
+    net::CReactorPool reactor_pool;
+    reactor_pool.create(1, 100, false);
+    net::CDnsResolver resolver;
+    resolver.create(1);
+
+    CResolveHandler handler;
+    handler.event_loop = reactor_pool.get_loop(0);
+    {
+        sys::LockHelper<sys::CLock> lock_helper(handler.lock);
+        resolver.async_resolve("localhost", &handler, handler.event_loop);
+        (void)handler.event.timed_wait(handler.lock, 5000);
+    }
+
+    resolver.destroy();
+    reactor_pool.destroy();
+    printf("async: in_loop_thread=%d, %d addresses\n", handler.in_loop_thread, handler.ip_number);
+    return handler.in_loop_thread && (handler.ip_number > 0);
+}
+
+static bool test_utils()
+{
+    net::string_ip_array_t ip_array;
+    std::string errinfo;
+    if (!net::CUtils::resolve_ip_address("localhost", ip_array, errinfo))
+    {
+        fprintf(stderr, "resolve_ip_address: %s\n", errinfo.c_str());
+        return false;
+    }
+
+    printf("utils: localhost is %s\n", ip_array[0].c_str());
+    return "127.0.0.1" == ip_array[0];
+}
+
+int main()
+{
+    try
+    {
+        if (!test_happy_eyeballs())
+            return 1;
+        if (!test_cache())
+            return 1;
+        if (!test_async())
+            return 1;
+        if (!test_utils())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("dns resolver ok\n");
+    return 0;
+}
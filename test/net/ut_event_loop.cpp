@@ -0,0 +1,271 @@
+#include "mooon/net/event_loop.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/utils.h"
+#include <algorithm>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace mooon;
+
+static volatile int task_number = 0;
+static volatile int timer_number = 0;
+
+class CCountTask: public net::ILoopTask
+{
+private:
+    virtual void execute(net::CEventLoop* event_loop)
+    {
+        if (!event_loop->in_loop_thread())
+            fprintf(stderr, "ERROR: task not run in loop thread\n");
+        __sync_fetch_and_add(&task_number, 1);
+    }
+};
+
+// 以post(utils::Functor<void>)投递
+static void count_task(int number)
+{
+    __sync_fetch_and_add(&task_number, number);
+}
+
+class CCountTimer: public net::ITimerHandler
+{
+private:
+    virtual uint32_t on_timer(net::CEventLoop* event_loop, uint64_t timer_id)
+    {
+        // 共触发3次，每次间隔10毫秒
+        return (__sync_add_and_fetch(&timer_number, 1) < 3)? 10: 0;
+    }
+};
+
+class CTimerTask: public net::ILoopTask
+{
+public:
+    CTimerTask(net::ITimerHandler* handler)
+        : _handler(handler)
+    {
+    }
+
+private:
+    virtual void execute(net::CEventLoop* event_loop)
+    {
+        event_loop->run_after(10, _handler);
+    }
+
+private:
+    net::ITimerHandler* _handler;
+};
+
+// 按预算读取，用完仍有数据时返回epoll_again，记录每次被调用读到的字节数
+class CBudgetReader: public net::CEpollable
+{
+public:
+    CBudgetReader(int fd, char name)
+        : _name(name)
+    {
+        set_fd(fd);
+    }
+
+    static std::string calls; // 各次调用的读者名，只在循环线程中访问
+    static size_t max_bytes;  // 单次读到的最大字节数
+
+private:
+    virtual net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+    {
+        const net::CIoBudget budget = static_cast<net::CEventLoop*>(input_ptr)->get_io_budget(this);
+        char buffer[1024];
+        size_t bytes = 0;
+
+        calls.push_back(_name);
+        while (bytes < budget.bytes)
+        {
+            const ssize_t n = ::recv(get_fd(), buffer, std::min(sizeof(buffer), budget.bytes-bytes), 0);
+            if (n <= 0)
+                break;
+            bytes += static_cast<size_t>(n);
+        }
+        if (bytes > max_bytes)
+            max_bytes = bytes;
+        return (bytes < budget.bytes)? net::epoll_read: net::epoll_again;
+    }
+
+private:
+    char _name;
+};
+
+std::string CBudgetReader::calls;
+size_t CBudgetReader::max_bytes = 0;
+
+// 一个持续可读的连接不会独占循环，其它连接在它读完之前就被处理
+static int test_budget()
+{
+    int greedy_fds[2], small_fds[2];
+    if ((-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, greedy_fds)) || (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, small_fds)))
+        return 1;
+
+    const std::string data(16384, 'g');
+    if ((::send(greedy_fds[1], data.data(), data.size(), 0) != static_cast<ssize_t>(data.size()))
+     || (::send(small_fds[1], "s", 1, 0) != 1))
+        return 1;
+
+    net::CEventLoop* event_loop = new net::CEventLoop;
+    event_loop->inc_refcount();
+    event_loop->set_io_budget(1024, 0);
+    event_loop->set_tenant_weight(1, 2);
+    event_loop->start();
+
+    CBudgetReader* greedy = new CBudgetReader(greedy_fds[0], 'g');
+    CBudgetReader* small = new CBudgetReader(small_fds[0], 's');
+    greedy->set_tenant(1); // 每次2048字节
+    greedy->set_nonblock(true);
+    small->set_nonblock(true);
+    net::CEpollable* epollables[2] = { greedy, small };
+    event_loop->post_add(epollables, 2, EPOLLIN);
+
+    sys::CUtils::millisleep(100);
+    event_loop->stop();
+    event_loop->dec_refcount();
+    ::close(greedy_fds[1]);
+    ::close(small_fds[1]);
+
+    // 16384字节每次2048，共8次再加一次读到EAGAIN
+    const std::string& calls = CBudgetReader::calls;
+    const uint64_t exhausted_number = sys::CMetricsRegistry::get_singleton()->get_counter("reactor.budget_exhausted")->get();
+    printf("budget calls: %s, max_bytes: %zu, exhausted: %" PRIu64 "\n", calls.c_str(), CBudgetReader::max_bytes, exhausted_number);
+    if ((calls.find('s') == std::string::npos) || (calls.find('s') > 1) || (CBudgetReader::max_bytes != 2048))
+        return 1;
+    return ((9 == std::count(calls.begin(), calls.end(), 'g')) && (8 == exhausted_number))? 0: 1;
+}
+
+// 处理一次耗时约5毫秒的对象
+class CSlowReader: public net::CEpollable
+{
+public:
+    CSlowReader(int fd)
+    {
+        set_fd(fd);
+    }
+
+private:
+    virtual net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+    {
+        char buffer[64];
+        (void)::recv(get_fd(), buffer, sizeof(buffer), 0);
+        sys::CUtils::millisleep(5);
+        return net::epoll_read;
+    }
+};
+
+// 超过阈值的处理被计数，每轮的度量被记录
+static int test_instrumentation()
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return 1;
+
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    net::CEventLoop* event_loop = new net::CEventLoop(7);
+    event_loop->inc_refcount();
+    event_loop->set_slow_handler_threshold(1000);
+    event_loop->start();
+
+    CSlowReader* slow = new CSlowReader(fds[0]);
+    event_loop->post_add(slow, EPOLLIN);
+    for (int i=0; i<3; ++i)
+    {
+        sys::CUtils::millisleep(20);
+        if (::send(fds[1], "x", 1, 0) != 1)
+            return 1;
+    }
+    sys::CUtils::millisleep(50);
+    event_loop->stop();
+    event_loop->dec_refcount();
+    ::close(fds[1]);
+
+    sys::CHistogramSnapshot iteration, events;
+    registry->get_histogram("reactor.loop7.iteration_ns")->get_snapshot(&iteration);
+    registry->get_histogram("reactor.loop7.events_per_wait")->get_snapshot(&events);
+    const uint64_t slow_number = registry->get_counter("reactor.loop7.slow_handlers")->get();
+    const uint64_t busy_ns = registry->get_counter("reactor.loop7.busy_ns")->get();
+    const uint64_t wait_ns = registry->get_counter("reactor.loop7.wait_ns")->get();
+    const int64_t pending_tasks = registry->get_gauge("reactor.loop7.pending_tasks")->get();
+    printf("slow handlers: %" PRIu64 ", iterations: %" PRIu64 ", busy_ns: %" PRIu64 ", wait_ns: %" PRIu64 "\n",
+           slow_number, iteration.get_count(), busy_ns, wait_ns);
+    if ((slow_number != 3) || (events.get_count() < 3) || (iteration.get_count() < 4) || (pending_tasks != 0))
+        return 1;
+    return ((busy_ns >= 15000000) && (wait_ns > 0))? 0: 1;
+}
+
+// 忙轮询的循环，投递的任务在下一轮即被执行
+static int test_busy_poll()
+{
+    net::CEventLoop* event_loop = new net::CEventLoop;
+    event_loop->inc_refcount();
+    const bool supported = event_loop->set_busy_poll(50);
+    event_loop->start();
+
+    const int number = task_number;
+    for (int i=0; i<10; ++i)
+        event_loop->post(utils::bind<void>(&count_task, 1));
+    sys::CUtils::millisleep(50);
+    event_loop->stop();
+    event_loop->dec_refcount();
+
+    printf("busy poll(%s): %d tasks (expected 10)\n", supported? "epoll": "user", task_number - number);
+    return (10 == task_number - number)? 0: 1;
+}
+
+int main()
+{
+    try
+    {
+        CCountTimer timer;
+        net::CReactorPool reactor_pool;
+        reactor_pool.create(2, 100, false);
+
+        for (int i=0; i<100; ++i)
+            reactor_pool.next_loop()->post(new CCountTask);
+        for (int i=0; i<100; ++i)
+            reactor_pool.next_loop()->post(utils::bind<void>(&count_task, 2));
+        reactor_pool.get_loop(0)->post(new CTimerTask(&timer));
+
+        // 带调度属性的分多轮执行，已过截止时间的被丢弃
+        for (int i=0; i<200; ++i)
+            reactor_pool.next_loop()->post(utils::bind<void>(&count_task, 1), sys::CTaskPriority(i%2));
+        reactor_pool.get_loop(0)->post(utils::bind<void>(&count_task, 1000), sys::CTaskPriority(0, 1));
+
+        sys::CUtils::millisleep(200);
+        reactor_pool.destroy();
+
+        // 轮询的循环，投递不需要唤醒，轮询期满后阻塞时仍能被唤醒
+        net::CEventLoop* polling_loop = new net::CEventLoop;
+        polling_loop->inc_refcount();
+        polling_loop->set_idle_strategy(sys::CIdleStrategy(sys::idle_spin_park, 1000, 10));
+        polling_loop->start();
+        for (int i=0; i<100; ++i)
+        {
+            polling_loop->post(utils::bind<void>(&count_task, 1));
+            if (0 == i % 10)
+                sys::CUtils::millisleep(5);
+        }
+        sys::CUtils::millisleep(100);
+        polling_loop->post(utils::bind<void>(&count_task, 1));
+        sys::CUtils::millisleep(50);
+        polling_loop->stop();
+        polling_loop->dec_refcount();
+
+        const uint64_t expired_number = sys::CMetricsRegistry::get_singleton()->get_counter("reactor.expired_tasks")->get();
+        printf("task_number: %d (expected 601)\n", task_number);
+        printf("timer_number: %d (expected 3)\n", timer_number);
+        printf("expired_number: %" PRIu64 " (expected 1)\n", expired_number);
+        if ((601 != task_number) || (3 != timer_number) || (1 != expired_number))
+            return 1;
+        if ((test_busy_poll() != 0) || (test_instrumentation() != 0))
+            return 1;
+        return test_budget();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+}
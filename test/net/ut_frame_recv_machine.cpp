@@ -0,0 +1,155 @@
+#include <mooon/net/frame_recv_machine.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#define BLOCK_SIZE 1024
+#define BODY_SIZE_MAX 100000
+
+struct Header
+{
+    uint32_t size;
+    uint32_t seq;
+};
+
+class CConnector
+{
+public:
+    CConnector(int fd)
+        :_fd(fd)
+    {
+    }
+
+    ssize_t readv(const struct iovec* iov, int iovcnt)
+    {
+        ++_readv_number;
+        return ::readv(_fd, iov, iovcnt);
+    }
+
+    int get_readv_number() const { return _readv_number; }
+
+private:
+    int _fd;
+    int _readv_number = 0;
+};
+
+class CProcessorManager
+{
+public:
+    bool on_header(const Header& header)
+    {
+        return header.size <= BODY_SIZE_MAX;
+    }
+
+    bool on_frame(const Header& header, const char* body, size_t body_size)
+    {
+        if ((header.seq != seqs.size()) || (body_size != header.size) || ((0 == body_size) != (NULL == body)))
+            return false;
+
+        seqs.push_back(header.seq);
+        for (size_t i=0; i<body_size; ++i)
+        {
+            if (body[i] != static_cast<char>('a' + (header.seq+i) % 26))
+                return false;
+        }
+        return true;
+    }
+
+public:
+    std::vector<uint32_t> seqs;
+};
+
+// 生成frame_number个帧，消息体大小各不相同，包括空消息体和大于块的消息体
+static std::string make_frames(uint32_t frame_number)
+{
+    std::string frames;
+    for (uint32_t seq=0; seq<frame_number; ++seq)
+    {
+        Header header;
+        header.seq = seq;
+        header.size = (0 == seq % 10)? 0: ((0 == seq % 33)? 5000: seq % 100);
+
+        frames.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (uint32_t i=0; i<header.size; ++i)
+            frames.push_back(static_cast<char>('a' + (seq+i) % 26));
+    }
+    return frames;
+}
+
+int main()
+{
+    const uint32_t frame_number = 500;
+    const std::string frames = make_frames(frame_number);
+
+    // 流水线的帧一次写入，批量接收解码
+    {
+        int fds[2];
+        if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            return 1;
+        (void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+        CConnector connector(fds[1]);
+        CProcessorManager processor_manager;
+        mooon::sys::CRawMemPool block_pool;
+        block_pool.create(BLOCK_SIZE, 4, false, 0);
+        mooon::net::CFrameRecvMachine<Header, CProcessorManager> recv_machine(&processor_manager, 0, &block_pool);
+
+        size_t written = 0;
+        mooon::utils::handle_result_t hr = mooon::utils::handle_continue;
+        while (written < frames.size())
+        {
+            const ssize_t bytes = write(fds[0], frames.data()+written, std::min(frames.size()-written, static_cast<size_t>(60000)));
+            if (bytes <= 0)
+                return 1;
+            written += bytes;
+
+            hr = recv_machine.receive(&connector);
+            if (mooon::utils::handle_error == hr)
+                return 1;
+        }
+        close(fds[0]);
+        if (mooon::utils::handle_close != recv_machine.receive(&connector))
+            return 1;
+        close(fds[1]);
+
+        printf("frames: %" PRIu64 ", copied: %" PRIu64 ", readv: %d\n",
+               recv_machine.get_frame_number(), recv_machine.get_copied_frame_number(), connector.get_readv_number());
+        if ((processor_manager.seqs.size() != frame_number) || (recv_machine.get_buffered_size() != 0))
+            return 1;
+        if (recv_machine.get_copied_frame_number() >= recv_machine.get_frame_number())
+            return 1;
+    }
+
+    // 逐字节地喂数据
+    {
+        CProcessorManager processor_manager;
+        mooon::net::CFrameRecvMachine<Header, CProcessorManager> recv_machine(&processor_manager, BLOCK_SIZE);
+        mooon::utils::handle_result_t hr = mooon::utils::handle_finish;
+
+        for (size_t i=0; i<frames.size(); ++i)
+        {
+            hr = recv_machine.work(&frames[i], 1);
+            if (mooon::utils::handle_error == hr)
+                return 1;
+        }
+        if ((mooon::utils::handle_finish != hr) || (processor_manager.seqs.size() != frame_number))
+            return 1;
+    }
+
+    // 包头检查不通过
+    {
+        CProcessorManager processor_manager;
+        mooon::net::CFrameRecvMachine<Header, CProcessorManager> recv_machine(&processor_manager);
+        Header header = { BODY_SIZE_MAX+1, 0 };
+        if (recv_machine.work(reinterpret_cast<const char*>(&header), sizeof(header)) != mooon::utils::handle_error)
+            return 1;
+        if (recv_machine.get_buffered_size() != 0)
+            return 1;
+    }
+
+    printf("frame recv machine ok\n");
+    return 0;
+}
@@ -0,0 +1,387 @@
+#include "mooon/net/http_server.h"
+#include "mooon/sys/clock.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+using namespace mooon;
+
+static ssize_t parse(net::CHttpRequestParser* parser, std::string* data, net::CHttpRequest* request)
+{
+    return parser->parse(&(*data)[0], data->size(), request);
+}
+
+static bool test_parser()
+{
+    net::CHttpRequestParser parser(1024, 100);
+    net::CHttpRequest request;
+
+    // 逐字节到达，最后一个字节到达时才完整
+    std::string data = "GET /search?q=1 HTTP/1.1\r\nHost: x\r\nX-Empty:\r\nConnection: Keep-Alive, Upgrade\r\n\r\n";
+    for (size_t i=1; i<data.size(); ++i)
+    {
+        std::string part = data.substr(0, i);
+        if (parse(&parser, &part, &request) != 0)
+            return false;
+    }
+    if ((parse(&parser, &data, &request) != static_cast<ssize_t>(data.size()))
+     || (request.get_method() != "GET") || (request.get_path() != "/search") || (request.get_query() != "q=1")
+     || (request.get_header("host") != "x") || (request.get_header("X-Empty") != "") || (3 != request.get_header_number())
+     || !request.is_keep_alive() || (1 != request.get_minor_version()))
+        return false;
+
+    // 流水线中的两个请求，第二个带消息体
+    data = "GET /a HTTP/1.0\r\n\r\nPOST /b HTTP/1.1\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+    ssize_t n = parse(&parser, &data, &request);
+    if ((n != 19) || request.is_keep_alive() || (request.get_path() != "/a"))
+        return false;
+    std::string second = data.substr(n);
+    if ((parse(&parser, &second, &request) != static_cast<ssize_t>(second.size())) || (request.get_body() != "hello") || request.is_keep_alive())
+        return false;
+
+    // 分块编码的消息体就地解码
+    data = "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nTrailer: x\r\n\r\nGET";
+    std::string partial = data.substr(0, data.size()-20);
+    if (parse(&parser, &partial, &request) != 0)
+        return false;
+    n = parse(&parser, &data, &request);
+    if ((n != static_cast<ssize_t>(data.size()-3)) || !request.is_chunked() || (request.get_body() != "hello world"))
+        return false;
+
+    // 各种错误
+    const struct { const char* request; int status; } errors[] =
+    {
+        { "POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n", 400 },
+        { "GET / HTTP/2.0\r\n\r\n", 505 },
+        { "GET /\r\n\r\n", 400 },
+        { "GET / HTTP/1.1\r\nBad Header: 1\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nContent-Length: 101\r\n\r\n", 413 },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 501 },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n65\r\n", 413 }
+    };
+    for (size_t i=0; i<sizeof(errors)/sizeof(errors[0]); ++i)
+    {
+        data = errors[i].request;
+        parser.reset();
+        if ((parse(&parser, &data, &request) != -1) || (parser.get_error_status() != errors[i].status))
+        {
+            printf("parser error case %zu: status %d\n", i, parser.get_error_status());
+            return false;
+        }
+    }
+    data = "GET / HTTP/1.1\r\nX: " + std::string(2000, 'x');
+    parser.reset();
+    if ((parse(&parser, &data, &request) != -1) || (431 != parser.get_error_status()))
+        return false;
+
+    printf("parser ok\n");
+    return true;
+}
+
+class CPingHandler: public net::IHttpHandler
+{
+private:
+    virtual void handle(const net::CHttpRequest& request, net::CHttpResponse* response)
+    {
+        response->set_content_type("text/plain");
+        response->append("pong");
+    }
+};
+
+class CEchoHandler: public net::IHttpHandler
+{
+private:
+    virtual void handle(const net::CHttpRequest& request, net::CHttpResponse* response)
+    {
+        response->append(request.get_body());
+    }
+};
+
+class CStreamHandler: public net::IHttpHandler
+{
+private:
+    virtual void handle(const net::CHttpRequest& request, net::CHttpResponse* response)
+    {
+        response->begin_chunked();
+        response->write_chunk("one,");
+        response->write_chunk("two,");
+        response->write_chunk(std::string(100000, 'z'));
+    }
+};
+
+class CStaticHandler: public net::IHttpHandler
+{
+private:
+    virtual void handle(const net::CHttpRequest& request, net::CHttpResponse* response)
+    {
+        response->append(request.get_path());
+    }
+};
+
+static int connect_to(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (-1 == connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 发送请求，收到对端关闭或milliseconds内没有新数据为止
+static std::string request(int fd, const std::string& data, int milliseconds=200, bool* closed=NULL)
+{
+    if (send(fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size()))
+        return std::string();
+
+    std::string response;
+    for (;;)
+    {
+        struct pollfd fds = { fd, POLLIN, 0 };
+        if (poll(&fds, 1, milliseconds) <= 0)
+            break;
+
+        char buffer[65536];
+        const ssize_t bytes = recv(fd, buffer, sizeof(buffer), 0);
+        if (bytes <= 0)
+        {
+            if (closed != NULL)
+                *closed = true;
+            break;
+        }
+        response.append(buffer, bytes);
+    }
+    return response;
+}
+
+static int count(const std::string& text, const std::string& pattern)
+{
+    int number = 0;
+    for (std::string::size_type pos=text.find(pattern); pos!=std::string::npos; pos=text.find(pattern, pos+1))
+        ++number;
+    return number;
+}
+
+static bool test_server(net::CHttpServer* server)
+{
+    const uint16_t port = server->get_port();
+    int fd = connect_to(port);
+    if (-1 == fd)
+        return false;
+
+    // 流水线的三个请求，应答按序
+    std::string response = request(fd, "GET /ping HTTP/1.1\r\nHost: x\r\n\r\n"
+                                       "POST /echo HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                                       "GET /static/a/b.html HTTP/1.1\r\n\r\n");
+    const std::string::size_type pong = response.find("\r\n\r\npong");
+    const std::string::size_type abc = response.find("\r\n\r\nabc");
+    const std::string::size_type html = response.find("\r\n\r\n/static/a/b.html");
+    if ((3 != count(response, "HTTP/1.1 200 OK\r\n")) || (std::string::npos == pong) || (std::string::npos == abc)
+     || (std::string::npos == html) || !((pong < abc) && (abc < html))
+     || (std::string::npos == response.find("Content-Length: 4\r\n")) || (std::string::npos == response.find("Date: ")))
+    {
+        printf("pipeline: %s\n", response.c_str());
+        return false;
+    }
+
+    // 404、405和HEAD
+    response = request(fd, "GET /none HTTP/1.1\r\n\r\nDELETE /ping HTTP/1.1\r\n\r\nHEAD /ping HTTP/1.1\r\n\r\n");
+    if ((std::string::npos == response.find("HTTP/1.1 404 Not Found")) || (std::string::npos == response.find("HTTP/1.1 405 Method Not Allowed"))
+     || (count(response, "pong") != 0) || (3 != count(response, "HTTP/1.1 ")))
+    {
+        printf("errors: %s\n", response.c_str());
+        return false;
+    }
+
+    // 分块应答
+    response = request(fd, "GET /stream HTTP/1.1\r\n\r\n");
+    if ((std::string::npos == response.find("Transfer-Encoding: chunked\r\n")) || (std::string::npos == response.find("4\r\none,\r\n4\r\ntwo,\r\n186a0\r\nzzz"))
+     || (response.compare(response.size()-5, 5, "0\r\n\r\n") != 0))
+    {
+        printf("chunked: %zu bytes\n", response.size());
+        return false;
+    }
+
+    // 错误的请求应答后关闭
+    bool closed = false;
+    response = request(fd, "GET / HTTP/3.0\r\n\r\n", 1000, &closed);
+    close(fd);
+    if (!closed || (std::string::npos == response.find("HTTP/1.1 505 ")) || (std::string::npos == response.find("Connection: close\r\n")))
+        return false;
+
+    // HTTP/1.0默认不保持连接
+    fd = connect_to(port);
+    closed = false;
+    response = request(fd, "GET /ping HTTP/1.0\r\n\r\n", 1000, &closed);
+    close(fd);
+    if (!closed || (std::string::npos == response.find("HTTP/1.0 200 OK\r\n")))
+        return false;
+
+    printf("server ok\n");
+    return true;
+}
+
+static bool test_idle_timeout(net::CHttpServer* server)
+{
+    int fd = connect_to(server->get_port());
+    bool closed = false;
+    const uint64_t start = sys::CClock::get_milliseconds();
+    (void)request(fd, "GET /ping HTTP/1.1\r\n\r\n", 3000, &closed);
+    close(fd);
+
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - start;
+    printf("idle connection closed after %" PRIu64"ms\n", milliseconds);
+    return closed && (milliseconds < 2500);
+}
+
+struct BenchContext
+{
+    uint16_t port;
+    volatile bool stop;
+    uint64_t responses;
+};
+
+// 每次流水线发送16个请求，应答的长度固定（Date的长度固定）
+static void* bench_client(void* param)
+{
+    BenchContext* context = static_cast<BenchContext*>(param);
+    const std::string one = "GET /ping HTTP/1.1\r\nHost: bench\r\n\r\n";
+    std::string batch;
+    for (int i=0; i<16; ++i)
+        batch += one;
+
+    int fd = connect_to(context->port);
+    std::string first = request(fd, one, 100);
+    const size_t response_size = first.size();
+    std::string buffer(response_size * 16, '\0');
+
+    uint64_t responses = 0;
+    while (!context->stop && (response_size > 0))
+    {
+        if (send(fd, batch.data(), batch.size(), 0) != static_cast<ssize_t>(batch.size()))
+            break;
+        if (recv(fd, &buffer[0], buffer.size(), MSG_WAITALL) != static_cast<ssize_t>(buffer.size()))
+            break;
+        responses += 16;
+    }
+    close(fd);
+    __atomic_add_fetch(&context->responses, responses, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static bool test_throughput()
+{
+    CPingHandler ping_handler;
+    net::CHttpServer server;
+    server.add_route("GET", "/ping", &ping_handler);
+    server.start(net::ip_address_t("127.0.0.1"), 0, 1);
+
+    BenchContext context = { server.get_port(), false, 0 };
+    pthread_t threads[4];
+    for (int i=0; i<4; ++i)
+        pthread_create(&threads[i], NULL, bench_client, &context);
+    const uint64_t start = sys::CClock::get_milliseconds();
+    sys::CUtils::millisleep(1000);
+    context.stop = true;
+    for (int i=0; i<4; ++i)
+        pthread_join(threads[i], NULL);
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - start;
+    server.stop();
+
+    // 客户端与服务端共用CPU，这里只检查明显的退化
+    const uint64_t rate = context.responses * 1000 / milliseconds;
+    printf("throughput: %" PRIu64" requests/s on one reactor\n", rate);
+    return rate > 20000;
+}
+
+// 每次只读8字节、处理1个请求，流水线的请求分多轮处理，应答仍完整且按序
+static bool test_io_budget()
+{
+    CPingHandler ping_handler;
+    CEchoHandler echo_handler;
+    net::CHttpServer server;
+    server.add_route("GET", "/ping", &ping_handler);
+    server.add_route("POST", "/echo", &echo_handler);
+    server.set_io_budget(8, 1);
+    server.start(net::ip_address_t("127.0.0.1"), 0, 1);
+
+    int fd = connect_to(server.get_port());
+    if (-1 == fd)
+        return false;
+    const std::string response = request(fd, "GET /ping HTTP/1.1\r\n\r\n"
+                                             "POST /echo HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                                             "GET /ping HTTP/1.1\r\n\r\n");
+    close(fd);
+    server.stop();
+
+    const std::string::size_type abc = response.find("\r\n\r\nabc");
+    if ((3 != count(response, "HTTP/1.1 200 OK\r\n")) || (std::string::npos == abc)
+     || (response.find("\r\n\r\npong") > abc) || (response.rfind("\r\n\r\npong") < abc))
+    {
+        printf("io budget: %s\n", response.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_parser())
+            return 1;
+
+        CPingHandler ping_handler;
+        CEchoHandler echo_handler;
+        CStreamHandler stream_handler;
+        CStaticHandler static_handler;
+        net::CHttpServer server;
+        server.add_route("GET", "/ping", &ping_handler);
+        server.add_route("POST", "/echo", &echo_handler);
+        server.add_route("", "/stream", &stream_handler);
+        server.add_route("GET", "/static/*", &static_handler);
+        server.set_idle_timeout(100);
+        server.start(net::ip_address_t("127.0.0.1"), 0, 2);
+
+        if (!test_server(&server))
+            return 1;
+        if (!test_idle_timeout(&server))
+            return 1;
+        server.stop();
+
+        sys::MetricsSnapshot snapshot;
+        sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+        printf("metrics: /ping requests=%" PRIu64", latency count=%" PRIu64", bad=%" PRIu64", not found=%" PRIu64"\n",
+               snapshot.counters["http.route./ping.requests"], snapshot.histograms["http.route./ping.latency_ns"].get_count(),
+               snapshot.counters["http.bad_requests"], snapshot.counters["http.not_found"]);
+        if ((snapshot.counters["http.route./ping.requests"] < 4) || (1 != snapshot.counters["http.bad_requests"])
+         || (1 != snapshot.counters["http.not_found"]) || (snapshot.gauges["http.connections"] != 0))
+            return 1;
+
+        if (!test_throughput())
+            return 1;
+        if (!test_io_budget())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("http server ok\n");
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include "mooon/net/io_buffer.h"
+#include "mooon/net/recv_machine.h"
+#include "mooon/net/send_machine.h"
+#include "mooon/sys/mem_tracker.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace mooon;
+
+// 直接在fd上收发的连接，非阻塞时无数据或发送缓冲区满返回-1
+class CConnector
+{
+public:
+    CConnector(int fd): _fd(fd) {}
+    int get_fd() const { return _fd; }
+
+    ssize_t readv(const struct iovec* iov, int iovcnt)
+    {
+        ssize_t bytes = ::readv(_fd, iov, iovcnt);
+        if ((-1 == bytes) && (errno != EAGAIN))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "readv");
+        return bytes;
+    }
+
+    ssize_t writev(const struct iovec* iov, int iovcnt)
+    {
+        ssize_t bytes = ::writev(_fd, iov, iovcnt);
+        if ((-1 == bytes) && (errno != EAGAIN))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "writev");
+        return bytes;
+    }
+
+private:
+    int _fd;
+};
+
+static std::string to_string(const net::CIoBuffer& buffer)
+{
+    std::string str(buffer.size(), '\0');
+    if (!str.empty())
+        (void)buffer.copy_out(&str[0], 0, str.size());
+    return str;
+}
+
+static int sg_released = 0;
+
+static void release_external(const char* data, size_t size, void* context)
+{
+    ++sg_released;
+}
+
+static bool test_basic(sys::CRawMemPool* block_pool)
+{
+    std::string data;
+    for (int i=0; i<1000; ++i)
+        data.push_back(static_cast<char>('a' + i % 26));
+
+    sg_released = 0;
+    net::CIoBuffer buffer(64, block_pool);
+    buffer.append(data.data(), data.size());
+    if ((data != to_string(buffer)) || (buffer.get_slice_number() < 2))
+        return false;
+    if ((block_pool != NULL) && (block_pool->get_available_number() == block_pool->get_pool_size()))
+        return false;
+
+    // slice共享块，不复制
+    net::CIoBuffer sliced;
+    size_t slice_size;
+    if (!buffer.slice(10, 500, &sliced) || (data.substr(10, 500) != to_string(sliced)) || buffer.slice(600, 401, &sliced))
+        return false;
+    const char* first = sliced.get_slice(0, &slice_size);
+    size_t buffer_slice_size;
+    if (first != buffer.get_slice(0, &buffer_slice_size) + 10)
+        return false;
+
+    // split后两部分拼起来仍是原来的数据
+    net::CIoBuffer head;
+    if (!buffer.split(333, &head) || (data.substr(0, 333) != to_string(head)) || (data.substr(333) != to_string(buffer)))
+        return false;
+    head.append(&buffer);
+    if ((data != to_string(head)) || !buffer.empty())
+        return false;
+
+    // 首块独占且前有空闲空间时prepend不分配新块
+    sliced.clear();
+    head.drain(5);
+    const size_t slice_number = head.get_slice_number();
+    head.prepend("01234", 5);
+    std::string expected = "01234" + data.substr(5);
+    if ((expected != to_string(head)) || (slice_number != head.get_slice_number()))
+        return false;
+    (void)head.slice(0, 1, &sliced);
+    head.prepend("xy", 2); // 首块被共享，不能写入
+    if ((("xy" + expected) != to_string(head)) || (slice_number+1 != head.get_slice_number()) || ("0" != to_string(sliced)))
+        return false;
+
+    // 跨片段的pullup
+    head.append_external("EXTERNAL", 8, release_external, NULL);
+    const char* contiguous = head.pullup(200);
+    if ((NULL == contiguous) || (0 != memcmp(contiguous, ("xy" + expected).data(), 200)) || (NULL != head.pullup(head.size()+1)))
+        return false;
+
+    sliced.clear();
+    head.clear();
+    printf("basic: %d external released\n", sg_released);
+    return 1 == sg_released;
+}
+
+struct MessageHeader
+{
+    uint32_t size;
+};
+
+class CProcessorManager
+{
+public:
+    CProcessorManager(): frame_number(0) {}
+    bool on_header(const MessageHeader& header) { return header.size < 100000; }
+    bool on_message(const MessageHeader& header, size_t finished_size, const char* buffer, size_t buffer_size)
+    {
+        body.append(buffer, buffer_size);
+        if (finished_size + buffer_size == header.size)
+            ++frame_number;
+        return true;
+    }
+
+public:
+    std::string body;
+    int frame_number;
+};
+
+// 代理的路径：收到后加上消息头直接转发，消息体不复制
+static bool test_proxy()
+{
+    int upstream[2], downstream[2];
+    if ((-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, upstream)) || (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, downstream)))
+        return false;
+
+    std::string payload(50000, 'p');
+    for (size_t i=0; i<payload.size(); ++i)
+        payload[i] = static_cast<char>(i % 251);
+    for (size_t offset=0; offset<payload.size();)
+    {
+        ssize_t bytes = write(upstream[1], payload.data()+offset, payload.size()-offset);
+        if (bytes <= 0)
+            return false;
+        offset += bytes;
+    }
+    (void)fcntl(upstream[0], F_SETFL, O_NONBLOCK);
+
+    CConnector in_connector(upstream[0]);
+    net::CIoBuffer in(4096);
+    ssize_t bytes;
+    while ((bytes = in.read_from(&in_connector)) > 0);
+    if (in.size() != payload.size())
+        return false;
+
+    size_t slice_size;
+    const char* body_data = in.get_slice(0, &slice_size);
+    net::CIoBuffer out;
+    MessageHeader header;
+    header.size = static_cast<uint32_t>(payload.size());
+    in.split(payload.size(), &out);
+    out.prepend(reinterpret_cast<const char*>(&header), sizeof(header));
+    const char* forwarded;
+    (void)out.get_slice(1, &slice_size);
+    forwarded = out.get_slice(1, &slice_size);
+    if (forwarded != body_data)
+        return false;
+
+    // 发送状态机发完后释放块，接收端以CRecvMachine直接处理链式缓冲区
+    CConnector out_connector(downstream[1]);
+    net::CSendMachine<CConnector> send_machine(&out_connector);
+    send_machine.push(&out);
+    if (!out.empty())
+        return false;
+
+    CConnector recv_connector(downstream[0]);
+    CProcessorManager processor_manager;
+    net::CRecvMachine<MessageHeader, CProcessorManager> recv_machine(&processor_manager);
+    net::CIoBuffer received(1024);
+    (void)fcntl(downstream[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(downstream[1], F_SETFL, O_NONBLOCK);
+    while (received.size() < sizeof(header)+payload.size())
+    {
+        (void)send_machine.continue_send();
+        if (received.read_from(&recv_connector) <= 0)
+            usleep(1000);
+    }
+    if (utils::handle_finish != recv_machine.work(received))
+        return false;
+    received.clear();
+
+    printf("proxy: %zu bytes forwarded, %d frame\n", processor_manager.body.size(), processor_manager.frame_number);
+    close(upstream[0]);
+    close(upstream[1]);
+    close(downstream[0]);
+    close(downstream[1]);
+    return send_machine.is_finish() && (1 == processor_manager.frame_number) && (payload == processor_manager.body);
+}
+
+int main()
+{
+    sys::CRawMemPool block_pool;
+    block_pool.create(255, 16); // 加上1字节警戒为256
+
+    try
+    {
+        if (!test_basic(NULL) || !test_basic(&block_pool))
+            return 1;
+        if (16 != block_pool.get_available_number())
+            return 1;
+        if (!test_proxy())
+            return 1;
+
+        // 从堆上分配的块计入io_buffer，全部释放后归零，从池中分配的计入池的统计
+        sys::CMemTracker* tracker = sys::CMemTracker::get_tracker("io_buffer");
+        sys::CMemTracker* pool_tracker = sys::CMemTracker::get_tracker("ut_io_buffer.pool");
+        block_pool.set_mem_tracker(pool_tracker);
+        {
+            net::CIoBuffer heap_buffer(1024);
+            net::CIoBuffer pool_buffer(1024, &block_pool);
+            std::string data(3000, 'x');
+            heap_buffer.append(data.data(), data.size());
+            pool_buffer.append(data.data(), 500);
+            printf("io_buffer bytes: %" PRId64 ", pool bytes: %" PRId64 "\n", tracker->get_bytes(), pool_tracker->get_bytes());
+            if ((tracker->get_bytes() < 3000) || (0 == pool_tracker->get_bytes()) || (pool_tracker->get_bytes() % 256 != 0))
+                return 1;
+        }
+        if ((tracker->get_bytes() != 0) || (pool_tracker->get_bytes() != 0) || (tracker->get_peak() < 3000))
+            return 1;
+        block_pool.set_mem_tracker(NULL);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    block_pool.destroy();
+    printf("io buffer ok\n");
+    return 0;
+}
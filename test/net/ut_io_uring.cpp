@@ -0,0 +1,252 @@
+#include "mooon/net/io_uring.h"
+#include "mooon/net/tcp_client.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace mooon;
+
+#define DATA_SIZE (1024*1024)
+
+struct WriteContext
+{
+    int fd;
+    const char* data;
+    size_t size;
+};
+
+// 分多次慢慢写，接收端以MSG_WAITALL一次收完
+static void* slow_write(void* param)
+{
+    WriteContext* context = static_cast<WriteContext*>(param);
+    for (size_t offset=0; offset<context->size;)
+    {
+        ssize_t bytes = write(context->fd, context->data+offset, std::min(context->size-offset, static_cast<size_t>(65536)));
+        if (bytes <= 0)
+            break;
+        offset += bytes;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static bool test_ring()
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return false;
+
+    net::CIoUring ring;
+    ring.create(8);
+
+    // 完整接收
+    std::string data(DATA_SIZE, '\0');
+    for (size_t i=0; i<data.size(); ++i)
+        data[i] = static_cast<char>(i % 251);
+    WriteContext context = { fds[0], data.data(), data.size() };
+    pthread_t thread;
+    pthread_create(&thread, NULL, slow_write, &context);
+
+    std::string received(DATA_SIZE, '\0');
+    int res = ring.recv(fds[1], &received[0], received.size(), MSG_WAITALL);
+    pthread_join(thread, NULL);
+    printf("recv MSG_WAITALL: %d bytes, %" PRIu64 " io_uring_enter\n", res, ring.get_enter_number());
+    if ((res != DATA_SIZE) || (received != data))
+        return false;
+
+    // 超时
+    char buffer[100];
+    res = ring.recv(fds[1], buffer, sizeof(buffer), 0, 50);
+    if (res != -ETIMEDOUT)
+        return false;
+    if (write(fds[0], "hello", 5) != 5)
+        return false;
+    res = ring.recv(fds[1], buffer, sizeof(buffer), MSG_WAITALL, 50);
+    printf("partial: %d\n", res);
+    if ((res != 5) || (0 != memcmp(buffer, "hello", 5)))
+        return false;
+
+    // 固定缓冲区
+    static char fixed[2][4096];
+    struct iovec iov[2] = { { fixed[0], sizeof(fixed[0]) }, { fixed[1], sizeof(fixed[1]) } };
+    ring.register_buffers(iov, 2);
+    memset(fixed[0], 'f', sizeof(fixed[0]));
+    if ((ring.write_fixed(fds[0], fixed[0], sizeof(fixed[0]), 0) != sizeof(fixed[0]))
+     || (ring.read_fixed(fds[1], fixed[1], sizeof(fixed[1]), 1) != sizeof(fixed[1]))
+     || (0 != memcmp(fixed[0], fixed[1], sizeof(fixed[0]))))
+        return false;
+    ring.unregister_buffers();
+
+    // multishot接收
+    static char blocks[8*64];
+    ring.provide_buffers(blocks, 64, 8);
+    ring.start_multishot_receive(fds[1]);
+    for (int i=0; i<20; ++i)
+    {
+        char message[32];
+        int size = snprintf(message, sizeof(message), "message%d", i);
+        if (write(fds[0], message, size) != size)
+            return false;
+
+        char* block;
+        uint16_t buffer_id;
+        bool more;
+        res = ring.wait_multishot_receive(&block, &buffer_id, &more, 1000);
+        if ((res != size) || (0 != memcmp(block, message, size)) || !more)
+        {
+            printf("multishot %d: res=%d, more=%d\n", i, res, more);
+            return false;
+        }
+        ring.recycle_buffer(buffer_id);
+    }
+
+    close(fds[0]);
+    char* block;
+    uint16_t buffer_id;
+    bool more;
+    res = ring.wait_multishot_receive(&block, &buffer_id, &more, 1000);
+    printf("multishot closed: res=%d, more=%d\n", res, more);
+    close(fds[1]);
+    return (0 == res) && !more;
+}
+
+// 多个定位写同时在途，完成顺序不定，按tag核对
+static bool test_async_file()
+{
+    char path[] = "/tmp/ut_io_uring.XXXXXX";
+    int fd = mkstemp(path);
+    if (-1 == fd)
+        return false;
+    unlink(path);
+
+    net::CIoUring ring;
+    ring.create(8);
+    static char blocks[16][4096];
+    for (int i=0; i<16; ++i)
+    {
+        memset(blocks[i], 'a'+i, sizeof(blocks[i]));
+        ring.queue_pwrite(fd, blocks[i], sizeof(blocks[i]), static_cast<uint64_t>(15-i)*4096, i);
+    }
+
+    uint64_t tags[16];
+    int results[16];
+    int number = 0;
+    uint32_t done_mask = 0;
+    while (number < 16)
+    {
+        const int n = ring.wait_completions(tags+number, results+number, 16-number, 1);
+        for (int i=number; i<number+n; ++i)
+        {
+            if ((results[i] != 4096) || (tags[i] >= 16))
+                return false;
+            done_mask |= 1U << tags[i];
+        }
+        number += n;
+    }
+    if (done_mask != 0xFFFF)
+        return false;
+
+    // fsync和读，混在同步操作之间的完成事件不丢失
+    ring.queue_fsync(fd, true, 100);
+    char buffer[4096];
+    ring.queue_pread(fd, buffer, sizeof(buffer), 0, 101);
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return false;
+    char c;
+    if ((write(fds[0], "x", 1) != 1) || (ring.recv(fds[1], &c, 1, 0) != 1))
+        return false;
+    close(fds[0]);
+    close(fds[1]);
+
+    number = ring.wait_completions(tags, results, 16, 2);
+    printf("async file: %d completions, %" PRIu64 " io_uring_enter\n", number, ring.get_enter_number());
+    close(fd);
+    return (2 == number) && (100 + 101 == tags[0] + tags[1]) && (0 == results[0] + results[1] - 4096)
+        && ('p' == buffer[0]); // 偏移0处是最后一块
+}
+
+static bool test_tcp_client()
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 1))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+        return false;
+
+    net::CTcpClient client;
+    client.set_peer(net::ip_node_t(ntohs(addr.sin_port), net::ip_address_t("127.0.0.1")));
+    client.set_connect_timeout_milliseconds(1000);
+    client.timed_connect();
+    if (!client.enable_io_uring())
+        return false;
+    int server_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+
+    std::string data(DATA_SIZE, 'd');
+    WriteContext context = { server_fd, data.data(), data.size() };
+    pthread_t thread;
+    pthread_create(&thread, NULL, slow_write, &context);
+
+    std::string received(DATA_SIZE, '\0');
+    size_t size = received.size();
+    bool ok = client.full_receive(&received[0], size);
+    pthread_join(thread, NULL);
+    if (!ok || (size != data.size()) || (received != data))
+        return false;
+
+    // 超时接收，只收到部分数据
+    char buffer[100];
+    if (write(server_fd, "hello", 5) != 5)
+        return false;
+    ssize_t bytes = client.timed_receive(buffer, sizeof(buffer), 50);
+    if (bytes != 5)
+        return false;
+
+    size = 5;
+    client.full_send("world", size);
+    if ((read(server_fd, buffer, sizeof(buffer)) != 5) || (0 != memcmp(buffer, "world", 5)))
+        return false;
+
+    // 对端关闭
+    close(server_fd);
+    size = sizeof(buffer);
+    ok = client.full_receive(buffer, size);
+    return !ok && (0 == size);
+}
+
+int main()
+{
+    if (!net::CIoUring::is_supported())
+    {
+        printf("io_uring not supported, skipped\n");
+        return 0;
+    }
+
+    try
+    {
+        if (!test_ring())
+            return 1;
+        if (!test_async_file())
+            return 1;
+        if (!test_tcp_client())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("io_uring ok\n");
+    return 0;
+}
@@ -0,0 +1,423 @@
+#include <mooon/net/ip_lpm.h>
+#include <mooon/net/ip_node.h>
+#include <mooon/net/utils.h>
+#include <mooon/sys/stop_watch.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+MOOON_NAMESPACE_USE
+
+// 与inet_pton对比，结果和转换后的地址都须相同
+static bool check_parse(const std::string& str)
+{
+    uint32_t expected[4], actual[4];
+    memset(expected, 0, sizeof(expected));
+    memset(actual, 0, sizeof(actual));
+
+    const bool expected4 = inet_pton(AF_INET, str.c_str(), expected) > 0;
+    const bool actual4 = net::CUtils::string_toipv4(str.c_str(), actual[0]);
+    if ((expected4 != actual4) || (expected4 && (expected[0] != actual[0])))
+    {
+        printf("ipv4 mismatch: %s\n", str.c_str());
+        return false;
+    }
+
+    // 不以'\0'结尾的版本，后面跟上会被忽略的字符
+    const std::string padded = str + "9:";
+    if (net::CUtils::string_toipv4(padded.data(), str.size(), actual[1]) != expected4)
+    {
+        printf("ipv4 size mismatch: %s\n", str.c_str());
+        return false;
+    }
+
+    const bool expected6 = inet_pton(AF_INET6, str.c_str(), expected) > 0;
+    const bool actual6 = net::CUtils::string_toipv6(str.c_str(), actual);
+    if ((expected6 != actual6) || (expected6 && (memcmp(expected, actual, sizeof(expected)) != 0)))
+    {
+        printf("ipv6 mismatch: %s\n", str.c_str());
+        return false;
+    }
+    if ((net::CUtils::string_toipv6(padded.data(), str.size(), actual) != expected6) || (net::CUtils::is_valid_ipv6(str.c_str()) != expected6))
+    {
+        printf("ipv6 size mismatch: %s\n", str.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool test_parse()
+{
+    static const char* cases[] = {
+        "0.0.0.0", "1.2.3.4", "255.255.255.255", "256.1.1.1", "1.2.3", "1.2.3.4.5", "01.2.3.4", "1.2.3.04", "1..3.4",
+        "1.2.3.4 ", " 1.2.3.4", "", ".", "1.2.3.", "999.1.1.1", "100.200.250.255",
+        "::", "::1", "1::", ":::", "1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8",
+        "1:2:3:4:5:6:7::8", "1::2::3", ":1::2", "1::2:", "12345::", "fFfF::", "::ffff:1.2.3.4", "::1.2.3.4",
+        "1:2:3:4:5:6:1.2.3.4", "1:2:3:4:5:6:7:1.2.3.4", "::ffff:1.2.3", "::ffff:01.2.3.4", "1.2.3.4::", "g::", "2001:db8::8a2e:370:7334"
+    };
+    for (size_t i=0; i<sizeof(cases)/sizeof(cases[0]); ++i)
+    {
+        if (!check_parse(cases[i]))
+            return false;
+    }
+
+    // 随机字符串，字符集中冒号、点和十六进制数字较多，容易组成合法或接近合法的地址
+    static const char alphabet[] = "0123456789abcdefABCDEF::::....x";
+    for (int i=0; i<300000; ++i)
+    {
+        std::string str;
+        const int length = random() % 24;
+        for (int j=0; j<length; ++j)
+            str.push_back(alphabet[random() % (sizeof(alphabet)-1)]);
+        if (!check_parse(str))
+            return false;
+    }
+
+    // 由合法的地址变异
+    for (int i=0; i<100000; ++i)
+    {
+        char buffer[INET6_ADDRSTRLEN];
+        uint32_t ip[4];
+        for (int j=0; j<4; ++j)
+            ip[j] = (random() % 3 == 0)? 0: static_cast<uint32_t>(random());
+        inet_ntop((i % 2 == 0)? AF_INET6: AF_INET, ip, buffer, sizeof(buffer));
+
+        std::string str = buffer;
+        if (!check_parse(str))
+            return false;
+        if (!str.empty())
+            str[random() % str.size()] = alphabet[random() % (sizeof(alphabet)-1)];
+        if (!check_parse(str))
+            return false;
+    }
+
+    // 与inet_pton的速度对比
+    std::vector<std::string> strs;
+    for (int i=0; i<1000; ++i)
+    {
+        char buffer[INET_ADDRSTRLEN];
+        const uint32_t ip = static_cast<uint32_t>(random());
+        strs.push_back(inet_ntop(AF_INET, &ip, buffer, sizeof(buffer)));
+    }
+    uint32_t sum = 0;
+    sys::CStopWatch stop_watch;
+    for (int k=0; k<1000; ++k)
+        for (size_t i=0; i<strs.size(); ++i)
+        {
+            uint32_t ip;
+            inet_pton(AF_INET, strs[i].c_str(), &ip);
+            sum += ip;
+        }
+    const uint64_t pton_ns = stop_watch.get_elapsed_nanoseconds();
+    for (int k=0; k<1000; ++k)
+        for (size_t i=0; i<strs.size(); ++i)
+        {
+            uint32_t ip;
+            net::CUtils::string_toipv4(strs[i].data(), strs[i].size(), ip);
+            sum -= ip;
+        }
+    const uint64_t parse_ns = stop_watch.get_elapsed_nanoseconds();
+    printf("ipv4 parse: inet_pton %.1fns, string_toipv4 %.1fns\n", pton_ns / 1e6, parse_ns / 1e6);
+    return 0 == sum;
+}
+
+struct Ipv4Rule
+{
+    uint32_t prefix; // 主机字节序
+    uint8_t depth;
+    uint32_t next_hop;
+};
+
+static bool brute_force_ipv4(const std::vector<Ipv4Rule>& rules, uint32_t host_ip, uint32_t* next_hop)
+{
+    int best = -1;
+    for (size_t i=0; i<rules.size(); ++i)
+    {
+        const uint32_t mask = (0 == rules[i].depth)? 0: (0xFFFFFFFFU << (32 - rules[i].depth));
+        if (((host_ip & mask) == rules[i].prefix) && (rules[i].depth > best))
+        {
+            best = rules[i].depth;
+            *next_hop = rules[i].next_hop;
+        }
+    }
+    return best >= 0;
+}
+
+static bool verify_ipv4(const net::CIpv4LpmTable& table, const std::vector<Ipv4Rule>& rules)
+{
+    std::vector<uint32_t> ips;
+    for (int i=0; i<20000; ++i)
+    {
+        // 一半落在某个前缀中，另一半随机
+        uint32_t host_ip = static_cast<uint32_t>(random()) ^ (static_cast<uint32_t>(random()) << 16);
+        if ((i % 2 == 0) && !rules.empty())
+        {
+            const Ipv4Rule& rule = rules[random() % rules.size()];
+            const uint32_t mask = (0 == rule.depth)? 0: (0xFFFFFFFFU << (32 - rule.depth));
+            host_ip = rule.prefix | (host_ip & ~mask);
+        }
+        ips.push_back(htonl(host_ip));
+
+        uint32_t expected = 0, actual = 0;
+        const bool expected_found = brute_force_ipv4(rules, host_ip, &expected);
+        const bool actual_found = table.lookup(htonl(host_ip), &actual);
+        if ((expected_found != actual_found) || (expected_found && (expected != actual)))
+        {
+            printf("ipv4 lookup mismatch: %08x %d/%u %d/%u\n", host_ip, expected_found, expected, actual_found, actual);
+            return false;
+        }
+    }
+
+    // 批量查找与逐个查找的结果相同
+    std::vector<uint32_t> next_hops(ips.size(), 0);
+    std::vector<char> found(ips.size());
+    table.lookup(&ips[0], ips.size(), &next_hops[0], reinterpret_cast<bool*>(&found[0]));
+    for (size_t i=0; i<ips.size(); ++i)
+    {
+        uint32_t next_hop = 0;
+        if ((table.lookup(ips[i], &next_hop) != (found[i] != 0)) || (found[i] && (next_hop != next_hops[i])))
+        {
+            printf("ipv4 batch lookup mismatch\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_ipv4()
+{
+    net::CIpv4LpmTable table;
+    std::vector<Ipv4Rule> rules;
+
+    // 同一个/16下多放些长短不一的前缀，使二级表组和覆盖关系都被覆盖到
+    for (int i=0; i<3000; ++i)
+    {
+        Ipv4Rule rule;
+        rule.depth = (i < 10)? (i * 3): static_cast<uint8_t>(random() % 33);
+        uint32_t ip = static_cast<uint32_t>(random()) ^ (static_cast<uint32_t>(random()) << 16);
+        if (i % 3 == 0)
+            ip = 0x0A0B0000 | (ip & 0xFFFF);
+        rule.prefix = ip & ((0 == rule.depth)? 0: (0xFFFFFFFFU << (32 - rule.depth)));
+        rule.next_hop = static_cast<uint32_t>(random()) & net::CIpv4LpmTable::MAX_NEXT_HOP;
+
+        // 重复的前缀以后插入的为准
+        for (size_t j=0; j<rules.size(); ++j)
+        {
+            if ((rules[j].prefix == rule.prefix) && (rules[j].depth == rule.depth))
+            {
+                rules.erase(rules.begin() + j);
+                break;
+            }
+        }
+        rules.push_back(rule);
+        table.insert(htonl(ip), rule.depth, rule.next_hop);
+    }
+    if ((table.size() != rules.size()) || !verify_ipv4(table, rules))
+        return false;
+    printf("ipv4: %zu rules, %zu tbl8 groups\n", table.size(), table.get_tbl8_group_number());
+
+    // 删除一半，被覆盖的短前缀重新生效
+    for (size_t i=0; i<rules.size(); )
+    {
+        if (random() % 2 == 0)
+        {
+            ++i;
+            continue;
+        }
+        if (!table.remove(htonl(rules[i].prefix), rules[i].depth))
+            return false;
+        rules.erase(rules.begin() + i);
+    }
+    if (table.remove(htonl(0x01020304), 32) && !verify_ipv4(table, rules))
+        return false;
+    if ((table.size() != rules.size()) || !verify_ipv4(table, rules))
+        return false;
+
+    // 长于24位的都删除后，二级表组都被回收
+    for (size_t i=0; i<rules.size(); )
+    {
+        if (rules[i].depth <= 24)
+        {
+            ++i;
+            continue;
+        }
+        table.remove(htonl(rules[i].prefix), rules[i].depth);
+        rules.erase(rules.begin() + i);
+    }
+    if ((table.get_tbl8_group_number() != 0) || !verify_ipv4(table, rules))
+    {
+        printf("ipv4: %zu tbl8 groups left\n", table.get_tbl8_group_number());
+        return false;
+    }
+
+    try
+    {
+        table.insert(0, 8, net::CIpv4LpmTable::MAX_NEXT_HOP + 1);
+        return false;
+    }
+    catch (utils::CException&)
+    {
+    }
+
+    table.clear();
+    uint32_t next_hop;
+    return !table.lookup(htonl(0x0A0B0C0D), &next_hop) && (0 == table.size());
+}
+
+struct Ipv6Rule
+{
+    uint32_t prefix[4]; // 网络字节序
+    uint8_t depth;
+    uint32_t next_hop;
+};
+
+static bool match_ipv6(const uint32_t* prefix, uint8_t depth, const uint32_t* ip)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(prefix);
+    const uint8_t* q = reinterpret_cast<const uint8_t*>(ip);
+    for (int bit=0; bit<depth; ++bit)
+    {
+        if (((p[bit/8] ^ q[bit/8]) >> (7 - bit%8)) & 1)
+            return false;
+    }
+    return true;
+}
+
+static bool verify_ipv6(const net::CIpv6LpmTable& table, const std::vector<Ipv6Rule>& rules)
+{
+    for (int i=0; i<20000; ++i)
+    {
+        uint32_t ip[4];
+        for (int j=0; j<4; ++j)
+            ip[j] = static_cast<uint32_t>(random()) ^ (static_cast<uint32_t>(random()) << 16);
+        if ((i % 2 == 0) && !rules.empty())
+        {
+            // 取某个前缀，之后的位随机
+            const Ipv6Rule& rule = rules[random() % rules.size()];
+            uint8_t* p = reinterpret_cast<uint8_t*>(ip);
+            const uint8_t* q = reinterpret_cast<const uint8_t*>(rule.prefix);
+            for (int bit=0; bit<rule.depth; ++bit)
+                p[bit/8] = (p[bit/8] & ~(0x80 >> (bit%8))) | (q[bit/8] & (0x80 >> (bit%8)));
+        }
+
+        int best = -1;
+        uint32_t expected = 0, actual = 0;
+        for (size_t k=0; k<rules.size(); ++k)
+        {
+            if ((rules[k].depth > best) && match_ipv6(rules[k].prefix, rules[k].depth, ip))
+            {
+                best = rules[k].depth;
+                expected = rules[k].next_hop;
+            }
+        }
+
+        const bool found = table.lookup(ip, &actual);
+        if ((found != (best >= 0)) || (found && (expected != actual)))
+        {
+            printf("ipv6 lookup mismatch: %d/%u %d/%u\n", best, expected, found, actual);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_ipv6()
+{
+    net::CIpv6LpmTable table;
+    std::vector<Ipv6Rule> rules;
+
+    for (int i=0; i<3000; ++i)
+    {
+        Ipv6Rule rule;
+        static const uint8_t depths[] = { 0, 1, 15, 16, 17, 22, 23, 32, 48, 63, 64, 65, 100, 124, 125, 127, 128 };
+        rule.depth = (i < 40)? depths[i % sizeof(depths)]: static_cast<uint8_t>(random() % 129);
+        for (int j=0; j<4; ++j)
+            rule.prefix[j] = static_cast<uint32_t>(random()) ^ (static_cast<uint32_t>(random()) << 16);
+        if (i % 2 == 0)
+            rule.prefix[0] = htonl(0x20010DB8); // 集中在一个/32下，子树更深
+        if (i % 4 == 0)
+            rule.prefix[1] = 0;
+
+        // 清除前缀之后的位，使比较重复前缀时简单
+        uint8_t* p = reinterpret_cast<uint8_t*>(rule.prefix);
+        for (int bit=rule.depth; bit<128; ++bit)
+            p[bit/8] &= ~(0x80 >> (bit%8));
+        rule.next_hop = static_cast<uint32_t>(random()) & net::CIpv6LpmTable::MAX_NEXT_HOP;
+
+        for (size_t j=0; j<rules.size(); ++j)
+        {
+            if ((rules[j].depth == rule.depth) && (0 == memcmp(rules[j].prefix, rule.prefix, sizeof(rule.prefix))))
+            {
+                rules.erase(rules.begin() + j);
+                break;
+            }
+        }
+        rules.push_back(rule);
+        table.insert(rule.prefix, rule.depth, rule.next_hop);
+    }
+
+    table.build();
+    if ((table.size() != rules.size()) || !verify_ipv6(table, rules))
+        return false;
+    printf("ipv6: %zu rules, %zu nodes, %zu leaves\n", table.size(), table.get_node_number(), table.get_leaf_number());
+
+    for (size_t i=0; i<rules.size(); )
+    {
+        if (random() % 2 == 0)
+        {
+            ++i;
+            continue;
+        }
+        if (!table.remove(rules[i].prefix, rules[i].depth))
+            return false;
+        rules.erase(rules.begin() + i);
+    }
+    table.build();
+    if (!verify_ipv6(table, rules))
+        return false;
+
+    net::ip_address_t ip("2001:db8::1");
+    uint32_t next_hop;
+    table.clear();
+    table.build();
+    return !table.lookup(ip, &next_hop) && (0 == table.get_node_number());
+}
+
+static bool test_hash()
+{
+    std::unordered_set<net::ip_address_t> ips;
+    std::unordered_set<net::ip_node_t> nodes;
+    ips.insert(net::ip_address_t("10.0.0.1"));
+    ips.insert(net::ip_address_t("10.0.0.1"));
+    ips.insert(net::ip_address_t("::1"));
+    nodes.insert(net::ip_node_t(80, net::ip_address_t("10.0.0.1")));
+    nodes.insert(net::ip_node_t(81, net::ip_address_t("10.0.0.1")));
+    nodes.insert(net::ip_node_t(80, net::ip_address_t("10.0.0.1")));
+    if ((ips.size() != 2) || (nodes.size() != 2))
+        return false;
+
+    // 相邻的地址低位也要分散
+    net::ip_address_hasher hasher;
+    std::unordered_set<uint64_t> buckets;
+    for (uint32_t i=0; i<1024; ++i)
+        buckets.insert(hasher(net::ip_address_t(htonl(0x0A000000 + (i << 8)))) & 1023);
+    return buckets.size() > 500;
+}
+
+int main()
+{
+    if (!test_parse())
+        return 1;
+    if (!test_ipv4())
+        return 1;
+    if (!test_ipv6())
+        return 1;
+    if (!test_hash())
+        return 1;
+
+    printf("ip lpm ok\n");
+    return 0;
+}
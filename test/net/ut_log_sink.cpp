@@ -0,0 +1,120 @@
+#include "mooon/net/log_sink.h"
+#include "mooon/net/udp_socket.h"
+#include "mooon/sys/logger.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace mooon;
+
+static const char* sg_dir = "/tmp";
+
+// 总是失败的sink，日志应写本地文件
+class CFailedSink: public sys::ILogSink
+{
+public:
+    CFailedSink(): calls(0) {}
+    virtual int send(const struct iovec* log_lines, int number) { ++calls; return 0; }
+    int calls;
+};
+
+static off_t get_file_size(const char* filename)
+{
+    struct stat st;
+    std::string filepath = std::string(sg_dir) + "/" + filename;
+    return (0 == stat(filepath.c_str(), &st))? st.st_size: -1;
+}
+
+// 日志拼成数据报发出，不写本地文件
+static bool test_udp()
+{
+    net::CUdpSocket receiver;
+    receiver.listen("127.0.0.1", 25140);
+
+    unlink("/tmp/ut_log_sink_udp.log");
+    sys::CLogger* logger = new sys::CLogger;
+    logger->create(sg_dir, "ut_log_sink_udp.log");
+    logger->set_sink(new net::CUdpLogSink("127.0.0.1", 25140, 512));
+    for (int i=0; i<200; ++i)
+        logger->log_info(__FILE__, __LINE__, NULL, "line %d\n", i);
+
+    int lines = 0;
+    int packets = 0;
+    char buffer[2048];
+    struct sockaddr_in from_addr;
+    while (lines < 200)
+    {
+        int bytes;
+        try
+        {
+            bytes = receiver.timed_receive_from(buffer, sizeof(buffer), &from_addr, 2000);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            printf("udp: %s\n", ex.str().c_str());
+            break;
+        }
+        if (bytes <= 0)
+            break;
+        if (bytes > 512)
+            return false;
+        ++packets;
+        for (int i=0; i<bytes; ++i)
+        {
+            if ('\n' == buffer[i])
+                ++lines;
+        }
+    }
+
+    logger->destroy();
+    printf("udp: %d lines in %d packets, local file %d bytes\n", lines, packets, (int)get_file_size("ut_log_sink_udp.log"));
+    return (200 == lines) && (packets < 200) && (0 == get_file_size("ut_log_sink_udp.log"));
+}
+
+// sink失败后写本地文件，重试间隔内不再调用sink
+static bool test_fallback()
+{
+    unlink("/tmp/ut_log_sink_fallback.log");
+    CFailedSink* sink = new CFailedSink;
+    sys::CLogger* logger = new sys::CLogger;
+    logger->create(sg_dir, "ut_log_sink_fallback.log");
+    logger->set_sink(sink, 60);
+    for (int i=0; i<10; ++i)
+    {
+        logger->log_info(__FILE__, __LINE__, NULL, "fallback %d\n", i);
+        sys::CUtils::millisleep(10);
+    }
+    sys::CUtils::millisleep(100);
+
+    const int calls = sink->calls;
+    const off_t size = get_file_size("ut_log_sink_fallback.log");
+    logger->destroy();
+
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    printf("fallback: %d calls, local file %d bytes, %d fallback\n", calls, (int)size, (int)snapshot.counters["logger.sink_fallback"]);
+    return (1 == calls) && (size > 0) && (10 == snapshot.counters["logger.sink_fallback"]);
+}
+
+int main()
+{
+    try
+    {
+        net::CUdpLogSink sink("256.0.0.1", 25140);
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+
+    if (!test_udp())
+        return 1;
+    if (!test_fallback())
+        return 1;
+
+    printf("log sink ok\n");
+    return 0;
+}
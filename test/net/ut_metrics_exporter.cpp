@@ -0,0 +1,132 @@
+#include "mooon/net/metrics_exporter.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <string>
+using namespace mooon;
+
+// 以HTTP/1.0请求path，返回完整的应答
+static std::string http_get(uint16_t port, const char* path)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (-1 == connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+    {
+        close(fd);
+        return std::string();
+    }
+
+    // 分两次发送请求头
+    const std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: localhost\r\n";
+    if ((write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+     || (usleep(10000), write(fd, "\r\n", 2) != 2))
+    {
+        close(fd);
+        return std::string();
+    }
+
+    std::string response;
+    char buffer[4096];
+    for (;;)
+    {
+        struct pollfd fds = { fd, POLLIN, 0 };
+        if (poll(&fds, 1, 1000) <= 0)
+            break;
+        const ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            break;
+        response.append(buffer, bytes);
+    }
+
+    close(fd);
+    return response;
+}
+
+static bool test_http(net::CMetricsExporter* exporter)
+{
+    const std::string prometheus = http_get(exporter->get_http_port(), "/metrics");
+    printf("prometheus: %zu bytes\n", prometheus.size());
+    if ((0 != prometheus.compare(0, 15, "HTTP/1.0 200 OK"))
+     || (std::string::npos == prometheus.find("# TYPE ut_requests counter\nut_requests 3\n"))
+     || (std::string::npos == prometheus.find("ut_backlog 7\n"))
+     || (std::string::npos == prometheus.find("ut_latency_ns{quantile=\"0.99\"} 99\n"))
+     || (std::string::npos == prometheus.find("ut_latency_ns_count 100\n")))
+        return false;
+
+    const std::string json = http_get(exporter->get_http_port(), "/metrics.json?pretty=0");
+    printf("json: %zu bytes\n", json.size());
+    if ((std::string::npos == json.find("Content-Type: application/json"))
+     || (std::string::npos == json.find("\"ut.requests\":3"))
+     || (std::string::npos == json.find("\"ut.latency_ns\":{\"count\":100,\"sum\":4950,\"mean\":49,\"min\":0,\"p50\":49,\"p99\":99,\"p999\":99,\"max\":99}")))
+        return false;
+
+    const std::string not_found = http_get(exporter->get_http_port(), "/nothing");
+    return (0 == not_found.compare(0, 22, "HTTP/1.0 404 Not Found")) && (3 == exporter->get_request_number());
+}
+
+static bool test_push(net::CUdpSocket* receiver)
+{
+    // 1秒推送一次
+    std::string text;
+    char buffer[2048];
+    struct sockaddr_in from_addr;
+    while (std::string::npos == text.find("ut_latency_ns_count"))
+    {
+        const int bytes = receiver->timed_receive_from(buffer, sizeof(buffer), &from_addr, 3000);
+        if (bytes <= 0)
+            return false;
+        if (bytes > 1400)
+            return false;
+        text.append(buffer, bytes);
+    }
+
+    printf("pushed %zu bytes\n", text.size());
+    return std::string::npos != text.find("ut_requests 3\n");
+}
+
+int main()
+{
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    registry->get_counter("ut.requests")->inc(3);
+    registry->get_gauge("ut.backlog")->set(7);
+    for (uint64_t i=0; i<100; ++i)
+        registry->get_histogram("ut.latency_ns")->record(i);
+    // 让推送的文本超过一个数据报
+    for (int i=0; i<100; ++i)
+        registry->get_counter(utils::CStringUtils::format_string("ut.padding_counter_%03d", i))->inc(i);
+
+    try
+    {
+        net::CUdpSocket receiver;
+        receiver.listen("127.0.0.1", 0);
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        if (-1 == getsockname(receiver.get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len))
+            return 1;
+
+        net::CMetricsExporter exporter;
+        exporter.enable_http("127.0.0.1", 0);
+        exporter.enable_push("127.0.0.1", ntohs(addr.sin_port), 1);
+        exporter.start();
+        printf("http port: %u\n", exporter.get_http_port());
+
+        if (!test_http(&exporter))
+            return 1;
+        if (!test_push(&receiver))
+            return 1;
+        exporter.stop();
+    }
+    catch (utils::CException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("metrics exporter ok\n");
+    return 0;
+}
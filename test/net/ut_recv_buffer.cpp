@@ -0,0 +1,121 @@
+#include <mooon/net/recv_buffer.h>
+#include <mooon/sys/metrics.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 以readv接收的连接，非阻塞时无数据返回-1
+class CConnector
+{
+public:
+    CConnector(int fd): _fd(fd) {}
+
+    ssize_t readv(const struct iovec* iov, int iovcnt)
+    {
+        return ::readv(_fd, iov, iovcnt);
+    }
+
+private:
+    int _fd;
+};
+
+static bool write_all(int fd, const std::string& data)
+{
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        const ssize_t bytes = write(fd, data.data()+offset, data.size()-offset);
+        if (bytes <= 0)
+            return false;
+        offset += static_cast<size_t>(bytes);
+    }
+    return true;
+}
+
+// 收完fd中所有的数据
+static std::string receive_all(mooon::net::CRecvBuffer* recv_buffer, int fd)
+{
+    for (;;)
+    {
+        const size_t space = recv_buffer->get_read_space();
+        const ssize_t bytes = recv_buffer->read_fd(fd, space);
+        if ((bytes <= 0) || (static_cast<size_t>(bytes) < space))
+            break;
+    }
+    return std::string(recv_buffer->data(), recv_buffer->size());
+}
+
+static bool test_grow_and_shrink(mooon::sys::CSlabMemPool* pool)
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return false;
+    (void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    mooon::sys::CGauge* gauge = mooon::sys::CMetricsRegistry::get_singleton()->get_gauge("recv_buffer.bytes");
+    mooon::net::CRecvBuffer recv_buffer(4096, pool);
+
+    // 没有数据可收时不分配
+    if ((recv_buffer.read_fd(fds[1], recv_buffer.get_read_space()) != -1) || (errno != EAGAIN) || (recv_buffer.capacity() != 0))
+        return false;
+
+    // 小消息收到落地区后只分配最小级别
+    const std::string small = "GET / HTTP/1.1\r\n\r\n";
+    if (!write_all(fds[0], small) || (receive_all(&recv_buffer, fds[1]) != small) || (recv_buffer.capacity() != 4096))
+        return false;
+    if (gauge->get() != 4096)
+        return false;
+    recv_buffer.drain(small.size());
+    if ((recv_buffer.capacity() != 0) || (gauge->get() != 0))
+        return false;
+
+    // 大消息增长到合适的级别，处理完后剩余的很少时缩小
+    std::string large(100000, 'x');
+    for (size_t i=0; i<large.size(); ++i)
+        large[i] = static_cast<char>('a' + i % 26);
+    std::string received;
+    if (!write_all(fds[0], large.substr(0, 60000)))
+        return false;
+    received = receive_all(&recv_buffer, fds[1]);
+    if (!write_all(fds[0], large.substr(60000)))
+        return false;
+    received = receive_all(&recv_buffer, fds[1]);
+    printf("large: size=%zu capacity=%zu\n", recv_buffer.size(), recv_buffer.capacity());
+    if ((received != large) || (recv_buffer.capacity() != 131072))
+        return false;
+
+    recv_buffer.drain(large.size() - 100);
+    if ((recv_buffer.capacity() != 4096) || (std::string(recv_buffer.data(), recv_buffer.size()) != large.substr(large.size()-100)))
+        return false;
+
+    // 以Connector接收，追加到剩余的数据之后
+    CConnector connector(fds[1]);
+    if (!write_all(fds[0], small) || (recv_buffer.read_from(&connector) != static_cast<ssize_t>(small.size())))
+        return false;
+    if (std::string(recv_buffer.data(), recv_buffer.size()) != large.substr(large.size()-100) + small)
+        return false;
+
+    recv_buffer.clear();
+    close(fds[0]);
+    close(fds[1]);
+    return (0 == recv_buffer.capacity()) && (0 == gauge->get());
+}
+
+int main()
+{
+    if (!test_grow_and_shrink(NULL))
+        return 1;
+
+    mooon::sys::CSlabMemPool pool;
+    pool.create(4096, 32768, 100, 4);
+    if (!test_grow_and_shrink(&pool))
+        return 1;
+    if (pool.get_occupancy() != 0)
+        return 1;
+
+    printf("recv buffer ok\n");
+    return 0;
+}
@@ -0,0 +1,614 @@
+#include "mooon/net/redis_client.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/string_utils.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <map>
+#include <poll.h>
+#include <pthread.h>
+#include <vector>
+using namespace mooon;
+
+// 模拟的Redis节点，集群模式下只处理slot_begin到slot_end之间的键
+struct FakeRedis
+{
+    int listen_fd;
+    uint16_t port;
+    uint16_t peer_port;  /** 另一个节点的端口，用于MOVED和ASK */
+    int slot_begin;
+    int slot_end;
+    bool empty_host;     /** MOVED中是否不带IP */
+    uint32_t delay_milliseconds; /** 应答前的延迟，模拟慢的副本 */
+    volatile bool stop;
+    pthread_t thread;
+    uint32_t recv_number;
+    uint32_t command_number;
+    uint32_t slots_number;
+    std::map<std::string, std::string> data;
+};
+
+static uint16_t g_port_a = 0;
+static uint16_t g_port_b = 0;
+
+static int listen_loopback(uint16_t* port)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 16))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+    {
+        close(listen_fd);
+        return -1;
+    }
+
+    *port = ntohs(addr.sin_port);
+    return listen_fd;
+}
+
+static std::string bulk(const std::string& str)
+{
+    return "$" + utils::CStringUtils::int_tostring(str.size()) + "\r\n" + str + "\r\n";
+}
+
+// 第一次CLUSTER SLOTS返回过时的映射（全部在A），之后返回正确的
+static std::string cluster_slots(FakeRedis* redis)
+{
+    if (1 == __atomic_add_fetch(&redis->slots_number, 1, __ATOMIC_RELAXED))
+        return "*1\r\n*3\r\n:0\r\n:16383\r\n*2\r\n" + bulk("127.0.0.1") + ":" + utils::CStringUtils::int_tostring(g_port_a) + "\r\n";
+
+    return "*2\r\n"
+           "*3\r\n:0\r\n:8191\r\n*3\r\n" + bulk("127.0.0.1") + ":" + utils::CStringUtils::int_tostring(g_port_a) + "\r\n" + bulk("a") +
+           "*3\r\n:8192\r\n:16383\r\n*3\r\n" + bulk("") + ":" + utils::CStringUtils::int_tostring(g_port_b) + "\r\n" + bulk("b");
+}
+
+static std::string execute(FakeRedis* redis, const net::redis_reply_t& command, bool* asking)
+{
+    std::vector<std::string> args;
+    for (std::vector<net::redis_reply_t>::size_type i=0; i<command.elements.size(); ++i)
+        args.push_back(command.elements[i].str);
+    ++redis->command_number;
+
+    const bool was_asking = *asking;
+    *asking = false;
+    if (args[0] == "PING")
+        return "+PONG\r\n";
+    if (args[0] == "HELLO")
+        return "%1\r\n" + bulk("server") + bulk("fake");
+    if (args[0] == "ASKING")
+    {
+        *asking = true;
+        return "+OK\r\n";
+    }
+    if ((args[0] == "CLUSTER") && (args[1] == "SLOTS"))
+        return cluster_slots(redis);
+    if (args[0] == "BLOCK")
+        return std::string();
+
+    const std::string& key = args[1];
+    const int slot = net::CRedisClient::get_key_slot(key);
+    if ((key == "{bar}x") && (redis->port == g_port_a))
+        return "-ASK " + utils::CStringUtils::int_tostring(slot) + " 127.0.0.1:" + utils::CStringUtils::int_tostring(redis->peer_port) + "\r\n";
+    if (((slot < redis->slot_begin) || (slot > redis->slot_end)) && !((key == "{bar}x") && was_asking))
+        return "-MOVED " + utils::CStringUtils::int_tostring(slot) + (redis->empty_host? " :": " 127.0.0.1:") + utils::CStringUtils::int_tostring(redis->peer_port) + "\r\n";
+
+    if (args[0] == "SET")
+    {
+        redis->data[key] = args[2];
+        return "+OK\r\n";
+    }
+    if (args[0] == "GET")
+    {
+        std::map<std::string, std::string>::iterator iter = redis->data.find(key);
+        return (iter == redis->data.end())? "$-1\r\n": bulk(iter->second);
+    }
+    if (args[0] == "INCR")
+    {
+        std::string& value = redis->data[key];
+        value = utils::CStringUtils::int_tostring(static_cast<int64_t>(atoll(value.c_str()) + 1));
+        return ":" + value + "\r\n";
+    }
+    return "-ERR unknown command\r\n";
+}
+
+struct FakeConnection
+{
+    int fd;
+    bool asking;
+    std::string input;
+    net::CRespParser parser;
+};
+
+static void* serve(void* param)
+{
+    FakeRedis* redis = static_cast<FakeRedis*>(param);
+    std::vector<FakeConnection*> connections;
+
+    while (!redis->stop)
+    {
+        std::vector<struct pollfd> fds(1);
+        fds[0].fd = redis->listen_fd;
+        fds[0].events = POLLIN;
+        for (std::vector<FakeConnection*>::size_type i=0; i<connections.size(); ++i)
+        {
+            struct pollfd pfd = { connections[i]->fd, POLLIN, 0 };
+            fds.push_back(pfd);
+        }
+        if (poll(&fds[0], fds.size(), 20) <= 0)
+            continue;
+
+        if (fds[0].revents & POLLIN)
+        {
+            FakeConnection* connection = new FakeConnection;
+            connection->fd = accept(redis->listen_fd, NULL, NULL);
+            connection->asking = false;
+            connections.push_back(connection);
+        }
+
+        for (std::vector<struct pollfd>::size_type i=fds.size()-1; i>0; --i)
+        {
+            FakeConnection* connection = connections[i-1];
+            if (0 == fds[i].revents)
+                continue;
+
+            char buffer[65536];
+            const ssize_t bytes = recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (bytes <= 0)
+            {
+                close(connection->fd);
+                delete connection;
+                connections.erase(connections.begin() + (i-1));
+                continue;
+            }
+
+            ++redis->recv_number;
+            connection->input.append(buffer, bytes);
+            std::string output;
+            size_t offset = 0;
+            for (;;)
+            {
+                size_t consumed = 0;
+                net::redis_reply_t command;
+                const int result = connection->parser.parse(connection->input.data()+offset, connection->input.size()-offset, &consumed, &command);
+                offset += consumed;
+                if (result != 1)
+                    break;
+                output += execute(redis, command, &connection->asking);
+            }
+            connection->input.erase(0, offset);
+            if (!output.empty())
+            {
+                size_t size = output.size();
+                if (redis->delay_milliseconds > 0)
+                    mooon::sys::CUtils::millisleep(redis->delay_milliseconds);
+                (void)send(connection->fd, output.data(), size, MSG_NOSIGNAL);
+            }
+        }
+    }
+
+    for (std::vector<FakeConnection*>::size_type i=0; i<connections.size(); ++i)
+    {
+        close(connections[i]->fd);
+        delete connections[i];
+    }
+    return NULL;
+}
+
+static bool start_redis(FakeRedis* redis, int slot_begin, int slot_end)
+{
+    redis->listen_fd = listen_loopback(&redis->port);
+    redis->peer_port = 0;
+    redis->slot_begin = slot_begin;
+    redis->slot_end = slot_end;
+    redis->empty_host = false;
+    redis->delay_milliseconds = 0;
+    redis->stop = false;
+    redis->recv_number = 0;
+    redis->command_number = 0;
+    redis->slots_number = 0;
+    return (redis->listen_fd != -1) && (0 == pthread_create(&redis->thread, NULL, serve, redis));
+}
+
+static void stop_redis(FakeRedis* redis)
+{
+    redis->stop = true;
+    pthread_join(redis->thread, NULL);
+    close(redis->listen_fd);
+}
+
+// 逐字节喂入也能得到同样的结果
+static bool test_parser()
+{
+    const std::string data =
+        "|1\r\n+ttl\r\n:3600\r\n"
+        "*8\r\n"
+        "+OK\r\n"
+        "$5\r\nhe\r\no\r\n"
+        "$-1\r\n"
+        "%2\r\n+a\r\n:1\r\n+b\r\n*2\r\n#t\r\n,3.5\r\n"
+        "=8\r\ntxt:abcd\r\n"
+        "(12345678901234567890\r\n"
+        "!5\r\nERR x\r\n"
+        "*-1\r\n"
+        ">2\r\n+message\r\n_\r\n";
+
+    for (size_t step=1; step<=data.size(); step*=7)
+    {
+        net::CRespParser parser;
+        net::redis_reply_t reply;
+        std::string buffer;
+        int result = 0;
+        size_t i = 0;
+        while ((i < data.size()) && (result != 1))
+        {
+            size_t consumed = 0;
+            buffer.append(data, i, step);
+            i += step;
+            result = parser.parse(buffer.data(), buffer.size(), &consumed, &reply);
+            if (result < 0)
+                return false;
+            buffer.erase(0, consumed);
+        }
+
+        if ((1 != result) || (net::reply_array != reply.type) || (8 != reply.elements.size()))
+            return false;
+        const std::vector<net::redis_reply_t>& e = reply.elements;
+        if ((net::reply_status != e[0].type) || (e[0].str != "OK")
+         || (net::reply_string != e[1].type) || (e[1].str != "he\r\no")
+         || !e[2].is_nil()
+         || (net::reply_map != e[3].type) || (4 != e[3].elements.size()) || (1 != e[3].elements[1].integer)
+         || (net::reply_boolean != e[3].elements[3].elements[0].type) || (3.5 != e[3].elements[3].elements[1].number)
+         || (net::reply_verbatim != e[4].type) || (e[4].str != "abcd")
+         || (net::reply_big_number != e[5].type)
+         || !e[6].is_error() || (e[6].str != "ERR x")
+         || !e[7].is_nil())
+            return false;
+
+        // 同一缓冲区中剩下的推送
+        size_t consumed = 0;
+        if (i < data.size())
+            buffer.append(data, i, std::string::npos);
+        if ((1 != parser.parse(buffer.data(), buffer.size(), &consumed, &reply))
+         || (net::reply_push != reply.type) || (consumed != buffer.size()) || !reply.elements[1].is_nil())
+            return false;
+    }
+
+    net::CRespParser parser;
+    net::redis_reply_t reply;
+    size_t consumed;
+    if (parser.parse("?bad\r\n", 6, &consumed, &reply) != -1)
+        return false;
+
+    std::vector<std::string> args(3);
+    args[0] = "SET";
+    args[1] = "k";
+    args[2] = "v";
+    std::string command;
+    net::CRespParser::format_command(args, &command);
+    return command == "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n";
+}
+
+static bool test_key_slot()
+{
+    std::vector<std::string> args(4);
+    std::string_view key;
+    args[0] = "EVAL";
+    args[1] = "return 1";
+    args[2] = "1";
+    args[3] = "k";
+    printf("slots: foo=%u, bar=%u, 123456789=%u\n",
+           net::CRedisClient::get_key_slot("foo"), net::CRedisClient::get_key_slot("bar"), net::CRedisClient::get_key_slot("123456789"));
+    return (12182 == net::CRedisClient::get_key_slot("foo"))
+        && (5061 == net::CRedisClient::get_key_slot("bar"))
+        && (12739 == net::CRedisClient::get_key_slot("123456789"))
+        && (net::CRedisClient::get_key_slot("{user1000}.following") == net::CRedisClient::get_key_slot("user1000"))
+        && net::CRedisClient::get_command_key(args, &key) && (key == "k")
+        && !net::CRedisClient::get_command_key(std::vector<std::string>(2, "PING"), &key);
+}
+
+class CCountCallback: public net::IRedisCallback
+{
+public:
+    CCountCallback(): _number(0), _errors(0) {}
+
+    uint32_t get_number() const { return __atomic_load_n(&_number, __ATOMIC_ACQUIRE); }
+    uint32_t get_errors() const { return _errors; }
+    int64_t get_last() const { return _last; }
+
+private:
+    virtual void on_reply(const net::redis_reply_t& reply)
+    {
+        if (reply.is_error())
+            ++_errors;
+        _last = reply.integer;
+        __atomic_add_fetch(&_number, 1, __ATOMIC_RELEASE);
+    }
+
+private:
+    uint32_t _number;
+    uint32_t _errors;
+    int64_t _last;
+};
+
+// 在事件循环线程中一次提交多个命令
+class CSubmitTask: public net::ILoopTask
+{
+public:
+    CSubmitTask(net::CRedisClient* redis_client, CCountCallback* callback, int number)
+        : _redis_client(redis_client), _callback(callback), _number(number)
+    {
+    }
+
+private:
+    virtual void execute(net::CEventLoop* event_loop)
+    {
+        std::vector<std::string> args(2);
+        args[0] = "INCR";
+        args[1] = "pipelined";
+        for (int i=0; i<_number; ++i)
+            _redis_client->async_command(args, _callback);
+    }
+
+private:
+    net::CRedisClient* _redis_client;
+    CCountCallback* _callback;
+    int _number;
+};
+
+static bool wait_number(const CCountCallback& callback, uint32_t number)
+{
+    for (int i=0; (i<500) && (callback.get_number() < number); ++i)
+        mooon::sys::CUtils::millisleep(10);
+    return callback.get_number() == number;
+}
+
+static std::vector<std::string> make_args(const char* a, const char* b=NULL, const char* c=NULL)
+{
+    std::vector<std::string> args(1, a);
+    if (b != NULL)
+        args.push_back(b);
+    if (c != NULL)
+        args.push_back(c);
+    return args;
+}
+
+static bool test_standalone(net::CEventLoop* event_loop, net::CTcpClientPool* client_pool)
+{
+    FakeRedis redis;
+    if (!start_redis(&redis, 0, 16383))
+        return false;
+
+    net::CRedisClient redis_client(event_loop, client_pool);
+    net::redis_reply_t reply;
+    redis_client.set_resp3(true);
+    redis_client.set_timeout_milliseconds(300);
+    redis_client.add_node(net::ip_node_t(redis.port, net::ip_address_t("127.0.0.1")));
+    redis_client.create();
+
+    if (!redis_client.command(make_args("PING"), &reply) || (net::reply_status != reply.type) || (reply.str != "PONG"))
+        return false;
+    if (!redis_client.command(make_args("SET", "k", "v"), &reply) || (reply.str != "OK")
+     || !redis_client.command(make_args("GET", "k"), &reply) || (net::reply_string != reply.type) || (reply.str != "v")
+     || !redis_client.command(make_args("GET", "missing"), &reply) || !reply.is_nil()
+     || !redis_client.command(make_args("INCR", "n"), &reply) || (1 != reply.integer))
+        return false;
+
+    // 同一轮提交的命令合并成一次发送
+    const int number = 1000;
+    const uint32_t recv_number = redis.recv_number;
+    const uint64_t send_number = redis_client.get_send_number();
+    CCountCallback callback;
+    event_loop->post(new CSubmitTask(&redis_client, &callback, number));
+    if (!wait_number(callback, number) || (callback.get_errors() != 0) || (number != callback.get_last()))
+        return false;
+    printf("pipelined %d commands: %" PRIu64" sends, %u server recvs\n",
+           number, redis_client.get_send_number() - send_number, redis.recv_number - recv_number);
+    if ((redis_client.get_send_number() - send_number > 2) || (redis.recv_number - recv_number > 10))
+        return false;
+
+    // 其它线程并发提交也被批量发送
+    CCountCallback thread_callback;
+    for (int i=0; i<number; ++i)
+        redis_client.async_command(make_args("INCR", "threaded"), &thread_callback);
+    if (!wait_number(thread_callback, number) || (thread_callback.get_errors() != 0))
+        return false;
+
+    // 超时的命令失败，连接被丢弃，之后的命令重新借用连接
+    if (!redis_client.command(make_args("BLOCK"), &reply) || !reply.is_error())
+        return false;
+    printf("block: %s\n", reply.str.c_str());
+    if (!redis_client.command(make_args("PING"), &reply) || (reply.str != "PONG"))
+        return false;
+
+    redis_client.destroy();
+    if (!redis_client.command(make_args("PING"), &reply) || !reply.is_error())
+        return false;
+    printf("standalone: %" PRIu64" commands, %" PRIu64" sends, %u server commands\n",
+           redis_client.get_command_number(), redis_client.get_send_number(), redis.command_number);
+    stop_redis(&redis);
+    return true;
+}
+
+// 在途命令数达到并发限制时立即以错误应答，不进入队列
+static bool test_limiter(net::CEventLoop* event_loop, net::CTcpClientPool* client_pool)
+{
+    FakeRedis redis;
+    if (!start_redis(&redis, 0, 16383))
+        return false;
+
+    mooon::sys::CConcurrencyLimiter limiter(new mooon::sys::CAimdLimit(10, 10, 10));
+    net::CRedisClient redis_client(event_loop, client_pool);
+    net::redis_reply_t reply;
+    redis_client.set_timeout_milliseconds(300);
+    redis_client.set_concurrency_limiter(&limiter);
+    redis_client.add_node(net::ip_node_t(redis.port, net::ip_address_t("127.0.0.1")));
+    redis_client.create();
+
+    const int number = 100;
+    CCountCallback callback;
+    event_loop->post(new CSubmitTask(&redis_client, &callback, number));
+    if (!wait_number(callback, number))
+        return false;
+    printf("limiter: %u errors, %" PRIu64 " rejected, %" PRIu64 " commands\n",
+           callback.get_errors(), redis_client.get_limit_rejected_number(), redis_client.get_command_number());
+    if ((callback.get_errors() != number-10) || (redis_client.get_limit_rejected_number() != static_cast<uint64_t>(number-10))
+     || (10 != redis_client.get_command_number()) || (limiter.get_in_flight() != 0))
+        return false;
+    if (!redis_client.command(make_args("PING"), &reply) || (reply.str != "PONG"))
+        return false;
+
+    redis_client.destroy();
+    stop_redis(&redis);
+    return true;
+}
+
+// 慢的副本上的读在对冲延迟后由另一个副本应答
+static bool test_hedged(net::CEventLoop* event_loop, net::CTcpClientPool* client_pool)
+{
+    FakeRedis slow_redis, fast_redis;
+    if (!start_redis(&slow_redis, 0, 16383) || !start_redis(&fast_redis, 0, 16383))
+        return false;
+    slow_redis.data["k"] = "v";
+    fast_redis.data["k"] = "v";
+    slow_redis.delay_milliseconds = 200;
+
+    net::CRedisClient slow_client(event_loop, client_pool);
+    net::CRedisClient fast_client(event_loop, client_pool);
+    slow_client.add_node(net::ip_node_t(slow_redis.port, net::ip_address_t("127.0.0.1")));
+    fast_client.add_node(net::ip_node_t(fast_redis.port, net::ip_address_t("127.0.0.1")));
+    slow_client.create();
+    fast_client.create();
+
+    mooon::sys::CHedgePolicy policy;
+    policy.delay_milliseconds = 20;
+    policy.budget_percent = 100;
+    mooon::sys::CHedgeController controller(policy);
+    net::CHedgedRedisClient hedged_client(event_loop, &controller);
+    hedged_client.add_replica(&slow_client);
+    hedged_client.add_replica(&fast_client);
+
+    // 轮流以两个副本为首选，慢的那两次被对冲
+    for (int i=0; i<4; ++i)
+    {
+        net::redis_reply_t reply;
+        const uint64_t begin = mooon::sys::CClock::get_milliseconds();
+        if (!hedged_client.read(make_args("GET", "k"), &reply) || (reply.str != "v"))
+            return false;
+        const uint64_t milliseconds = mooon::sys::CClock::get_milliseconds() - begin;
+        if (milliseconds >= 150)
+        {
+            printf("hedged read %d: %" PRIu64 "ms\n", i, milliseconds);
+            return false;
+        }
+    }
+
+    printf("hedged: %" PRIu64 " hedges, %" PRIu64 " won\n", controller.get_hedge_number(), controller.get_won_number());
+    if ((2 != controller.get_hedge_number()) || (2 != controller.get_won_number()))
+        return false;
+
+    slow_client.destroy();
+    fast_client.destroy();
+    stop_redis(&slow_redis);
+    stop_redis(&fast_redis);
+    return true;
+}
+
+static bool test_cluster(net::CEventLoop* event_loop, net::CTcpClientPool* client_pool)
+{
+    FakeRedis redis_a, redis_b;
+    if (!start_redis(&redis_a, 0, 8191) || !start_redis(&redis_b, 8192, 16383))
+        return false;
+    g_port_a = redis_a.port;
+    g_port_b = redis_b.port;
+    redis_a.peer_port = redis_b.port;
+    redis_b.peer_port = redis_a.port;
+    redis_b.empty_host = true;
+
+    net::CRedisClient redis_client(event_loop, client_pool);
+    net::redis_reply_t reply;
+    redis_client.set_cluster(true);
+    redis_client.add_node(net::ip_node_t(redis_a.port, net::ip_address_t("127.0.0.1")));
+    redis_client.create();
+
+    // 第一次取到的映射全部指向A，属于B的键被MOVED
+    CCountCallback callback;
+    const int number = 200;
+    for (int i=0; i<number; ++i)
+    {
+        const std::string key = "key" + utils::CStringUtils::int_tostring(i);
+        std::vector<std::string> args = make_args("SET", key.c_str(), key.c_str());
+        redis_client.async_command(args, &callback);
+    }
+    if (!wait_number(callback, number) || (callback.get_errors() != 0))
+        return false;
+
+    for (int i=0; i<number; ++i)
+    {
+        const std::string key = "key" + utils::CStringUtils::int_tostring(i);
+        FakeRedis& owner = (net::CRedisClient::get_key_slot(key) < 8192)? redis_a: redis_b;
+        if (owner.data[key] != key)
+            return false;
+        if (!redis_client.command(make_args("GET", key.c_str()), &reply) || (reply.str != key))
+            return false;
+    }
+    const uint64_t moved_number = redis_client.get_moved_number();
+    printf("cluster: %" PRIu64" moved, %" PRIu64" slots refresh, A %u commands, B %u commands\n",
+           moved_number, redis_client.get_slots_refresh_number(), redis_a.command_number, redis_b.command_number);
+    if ((0 == moved_number) || (redis_client.get_slots_refresh_number() < 2))
+        return false;
+
+    // 映射更新后不再重定向
+    if (!redis_client.command(make_args("INCR", "foo"), &reply) || (1 != reply.integer) || (redis_client.get_moved_number() != moved_number))
+        return false;
+
+    // 槽属于A的{bar}x正在迁移到B，ASK不更新映射，只对本次命令生效
+    if (!redis_client.command(make_args("SET", "{bar}x", "1"), &reply) || (reply.str != "OK")
+     || (1 != redis_client.get_ask_number()) || (redis_b.data["{bar}x"] != "1"))
+        return false;
+
+    redis_client.destroy();
+    stop_redis(&redis_a);
+    stop_redis(&redis_b);
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_parser())
+            return 1;
+        if (!test_key_slot())
+            return 1;
+
+        net::CReactorPool reactor_pool;
+        reactor_pool.create(1, 100, false);
+        net::CTcpClientPool client_pool(reactor_pool.get_loop(0), 1, 4, 16);
+        client_pool.create(16, 100);
+
+        if (!test_standalone(reactor_pool.get_loop(0), &client_pool))
+            return 1;
+        if (!test_cluster(reactor_pool.get_loop(0), &client_pool))
+            return 1;
+        if (!test_limiter(reactor_pool.get_loop(0), &client_pool))
+            return 1;
+        if (!test_hedged(reactor_pool.get_loop(0), &client_pool))
+            return 1;
+
+        client_pool.destroy();
+        reactor_pool.destroy();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("redis client ok\n");
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include "mooon/net/tcp_client.h"
+#include "mooon/net/utils.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string>
+#if __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#endif
+using namespace mooon;
+
+#define FILE_SIZE (4*1024*1024)
+
+struct TransferContext
+{
+    int fd;
+    std::string data;
+};
+
+static void* write_all(void* param)
+{
+    TransferContext* context = static_cast<TransferContext*>(param);
+    for (size_t offset=0; offset<context->data.size();)
+    {
+        ssize_t bytes = write(context->fd, context->data.data()+offset, context->data.size()-offset);
+        if (bytes <= 0)
+            break;
+        offset += bytes;
+    }
+    return NULL;
+}
+
+static void* read_all(void* param)
+{
+    TransferContext* context = static_cast<TransferContext*>(param);
+    char buffer[65536];
+    while (context->data.size() < FILE_SIZE)
+    {
+        ssize_t bytes = read(context->fd, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            break;
+        context->data.append(buffer, bytes);
+    }
+    return NULL;
+}
+
+static int make_temp_file()
+{
+    char path[] = "/tmp/ut_send_file.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1)
+        unlink(path);
+    return fd;
+}
+
+static bool connect_loopback(net::CTcpClient* client, int* server_fd)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 1))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+    {
+        close(listen_fd);
+        return false;
+    }
+
+    client->set_peer(net::ip_node_t(ntohs(addr.sin_port), net::ip_address_t("127.0.0.1")));
+    client->set_connect_timeout_milliseconds(1000);
+    client->timed_connect();
+    *server_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    return *server_fd != -1;
+}
+
+// 从连接splice到文件，对端关闭时返回false
+static bool test_splice_tofile(const std::string& data)
+{
+    net::CTcpClient client;
+    int server_fd;
+    if (!connect_loopback(&client, &server_fd))
+        return false;
+
+    int file_fd = make_temp_file();
+    TransferContext context = { server_fd, data };
+    pthread_t thread;
+    pthread_create(&thread, NULL, write_all, &context);
+
+    size_t size = data.size();
+    bool ok = client.full_splice_tofile(file_fd, size, 0);
+    pthread_join(thread, NULL);
+
+    std::string received(data.size(), '\0');
+    if (!ok || (size != data.size())
+     || (pread(file_fd, &received[0], received.size(), 0) != static_cast<ssize_t>(received.size()))
+     || (received != data))
+    {
+        close(file_fd);
+        close(server_fd);
+        return false;
+    }
+
+    // 只收到一半时对端关闭
+    if (write(server_fd, data.data(), 1000) != 1000)
+        return false;
+    close(server_fd);
+    size = 2000;
+    ok = client.full_splice_tofile(file_fd, size, 0);
+    close(file_fd);
+    printf("splice closed: %d, %zu\n", ok, size);
+    return !ok && (1000 == size);
+}
+
+// 非阻塞连接分块发送，每次调用最多发送chunk_size*chunk_number字节
+static bool test_continue_send_file(const std::string& data)
+{
+    net::CTcpClient client;
+    int server_fd;
+    if (!connect_loopback(&client, &server_fd))
+        return false;
+
+    int file_fd = make_temp_file();
+    if (write(file_fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+        return false;
+
+    TransferContext context = { server_fd, std::string() };
+    pthread_t thread;
+    pthread_create(&thread, NULL, read_all, &context);
+
+    client.set_nonblock(true);
+    off_t offset = 0;
+    size_t count = data.size();
+    int calls = 0;
+    for (;;)
+    {
+        ++calls;
+        const size_t last_count = count;
+        if (utils::handle_finish == client.continue_send_file(file_fd, &offset, count, 65536, 2))
+            break;
+        if (last_count - count > 2*65536)
+            return false;
+
+        struct pollfd fds = { client.get_fd(), POLLOUT, 0 };
+        (void)poll(&fds, 1, 1000);
+    }
+    pthread_join(thread, NULL);
+    close(file_fd);
+    close(server_fd);
+
+    printf("continue_send_file: %d calls, offset %ld\n", calls, static_cast<long>(offset));
+    return (offset == static_cast<off_t>(data.size())) && (calls >= FILE_SIZE/(2*65536)) && (context.data == data);
+}
+
+// 内核不支持kTLS时跳过
+static bool test_ktls()
+{
+#if __has_include(<linux/tls.h>)
+    net::CTcpClient client;
+    int server_fd;
+    if (!connect_loopback(&client, &server_fd))
+        return false;
+
+    struct tls12_crypto_info_aes_gcm_128 crypto_info;
+    memset(&crypto_info, 0, sizeof(crypto_info));
+    crypto_info.info.version = TLS_1_2_VERSION;
+    crypto_info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    if (!client.enable_ktls(true, &crypto_info, sizeof(crypto_info)))
+    {
+        printf("ktls not supported: %s\n", strerror(errno));
+        close(server_fd);
+        return true;
+    }
+
+    // 发出的是TLS应用数据记录
+    size_t size = 5;
+    client.full_send("hello", size);
+    unsigned char record[64];
+    ssize_t bytes = read(server_fd, record, sizeof(record));
+    close(server_fd);
+    printf("ktls record: %zd bytes\n", bytes);
+    return (bytes > 5) && (0x17 == record[0]) && (0x03 == record[1]) && (0x03 == record[2]);
+#else
+    return true;
+#endif
+}
+
+int main()
+{
+    std::string data(FILE_SIZE, '\0');
+    for (size_t i=0; i<data.size(); ++i)
+        data[i] = static_cast<char>(i % 253);
+
+    try
+    {
+        if (!test_splice_tofile(data))
+            return 1;
+        if (!test_continue_send_file(data))
+            return 1;
+        if (!test_ktls())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("send file ok\n");
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include <mooon/net/send_machine.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+
+// 直接在fd上发送的连接，非阻塞时发送缓冲区满返回-1
+class CConnector
+{
+public:
+    CConnector(int fd)
+        :_fd(fd)
+    {
+    }
+
+    int get_fd() const { return _fd; }
+
+    ssize_t writev(const struct iovec* iov, int iovcnt)
+    {
+        ssize_t bytes = ::writev(_fd, iov, iovcnt);
+        if ((-1 == bytes) && (errno != EAGAIN))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "writev");
+        return bytes;
+    }
+
+private:
+    int _fd;
+};
+
+static int sg_released = 0;
+
+static void release(const char* data, size_t size, void* context)
+{
+    ++sg_released;
+    *static_cast<size_t*>(context) = size;
+}
+
+// 边发边收，直到发送完，返回收到的数据
+static std::string transfer(mooon::net::CSendMachine<CConnector>* send_machine, int send_fd, int recv_fd)
+{
+    std::string received;
+    char buffer[8192];
+
+    while (mooon::utils::handle_continue == send_machine->continue_send())
+    {
+        struct pollfd fds[2] = { { send_fd, POLLOUT, 0 }, { recv_fd, POLLIN, 0 } };
+        (void)poll(fds, 2, 1000);
+
+        ssize_t bytes;
+        while ((bytes = read(recv_fd, buffer, sizeof(buffer))) > 0)
+            received.append(buffer, bytes);
+    }
+
+    // 已全部写入发送缓冲区，收完剩余的
+    (void)fcntl(recv_fd, F_SETFL, fcntl(recv_fd, F_GETFL) & ~O_NONBLOCK);
+    (void)shutdown(send_fd, SHUT_WR);
+    ssize_t bytes;
+    while ((bytes = read(recv_fd, buffer, sizeof(buffer))) > 0)
+        received.append(buffer, bytes);
+    return received;
+}
+
+static bool test_partial_write()
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return false;
+
+    int buffer_size = 4096;
+    (void)setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+    (void)fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    CConnector connector(fds[0]);
+    mooon::net::CSendMachine<CConnector> send_machine(&connector);
+    if (send_machine.enable_zerocopy(1)) // Unix域不支持零拷贝
+        return false;
+
+    // 消息头和消息体分开入队，不需要拼接
+    const std::string header = "HEAD0008";
+    const std::string body(200000, 'b');
+    const std::string tail = "TAIL";
+    size_t body_released = 0, tail_released = 0;
+    send_machine.push(header.data(), header.size());
+    send_machine.push(body.data(), body.size(), release, &body_released);
+    send_machine.push(tail.data(), tail.size(), release, &tail_released);
+    send_machine.push(tail.data(), 0, release, &tail_released); // 空段立即释放
+    if ((send_machine.get_segment_number() != 3) || (send_machine.get_remain_size() != header.size()+body.size()+tail.size()))
+        return false;
+
+    const std::string received = transfer(&send_machine, fds[0], fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("received %zu bytes, released %d segments\n", received.size(), sg_released);
+    return (received == header + body + tail)
+        && (3 == sg_released)
+        && (body.size() == body_released)
+        && (tail.size() == tail_released)
+        && send_machine.is_finish()
+        && (0 == send_machine.get_remain_size());
+}
+
+static bool test_zerocopy()
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 1))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+    {
+        close(listen_fd);
+        return false;
+    }
+
+    int send_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (-1 == connect(send_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+        return false;
+    int recv_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    (void)fcntl(send_fd, F_SETFL, O_NONBLOCK);
+    (void)fcntl(recv_fd, F_SETFL, O_NONBLOCK);
+
+    CConnector connector(send_fd);
+    mooon::net::CSendMachine<CConnector> send_machine(&connector);
+    if (!send_machine.enable_zerocopy(16384))
+    {
+        printf("MSG_ZEROCOPY not supported, skipped\n");
+        close(send_fd);
+        close(recv_fd);
+        return true;
+    }
+
+    const std::string small = "small";
+    const std::string large(1024*1024, 'z');
+    size_t small_released = 0, large_released = 0;
+    sg_released = 0;
+    send_machine.push(small.data(), small.size(), release, &small_released);
+    send_machine.push(large.data(), large.size(), release, &large_released);
+
+    const std::string received = transfer(&send_machine, send_fd, recv_fd);
+
+    // 数据已被对端收到，完成通知很快会到
+    for (int i=0; (i<100) && (send_machine.get_zerocopy_pending_number() > 0); ++i)
+    {
+        usleep(10000);
+        send_machine.reap_zerocopy();
+    }
+    close(send_fd);
+    close(recv_fd);
+
+    printf("zerocopy: received %zu bytes, released %d segments\n", received.size(), sg_released);
+    return (received == small + large)
+        && (2 == sg_released)
+        && (large.size() == large_released)
+        && (0 == send_machine.get_zerocopy_pending_number());
+}
+
+// 记录水位回调，长时间暂停的生产者应在on_low_watermark后恢复
+class CWatermarkObserver: public mooon::net::ISendWatermarkObserver
+{
+public:
+    CWatermarkObserver(): high_number(0), low_number(0) {}
+
+    virtual void on_high_watermark(size_t queued_size) { ++high_number; }
+    virtual void on_low_watermark(size_t queued_size) { ++low_number; }
+
+    int high_number;
+    int low_number;
+};
+
+static bool test_watermarks()
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return false;
+    (void)fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    mooon::net::CSendBudget* budget = mooon::net::CSendBudget::get_singleton();
+    CConnector connector(fds[0]);
+    CWatermarkObserver observer;
+    mooon::net::CSendMachine<CConnector> send_machine(&connector);
+    send_machine.set_watermarks(100000, 10000, &observer);
+
+    // 低于高水位不通知，达到后只通知一次
+    const std::string chunk(40000, 'w');
+    send_machine.push(chunk.data(), chunk.size());
+    send_machine.push(chunk.data(), chunk.size());
+    if (send_machine.is_paused() || (observer.high_number != 0) || (budget->get_bytes() < 2*chunk.size()))
+        return false;
+    send_machine.push(chunk.data(), chunk.size());
+    send_machine.push(chunk.data(), chunk.size());
+    if (!send_machine.is_paused() || (observer.high_number != 1) || (budget->get_paused_number() != 1))
+        return false;
+
+    // 发送完降到低水位以下后恢复
+    const std::string received = transfer(&send_machine, fds[0], fds[1]);
+    if ((received.size() != 4*chunk.size()) || send_machine.is_paused()
+     || (observer.low_number != 1) || (send_machine.get_queued_size() != 0) || (budget->get_paused_number() != 0))
+        return false;
+
+    // 全局预算超出时，高于低水位即暂停，reset后恢复
+    CWatermarkObserver observer2;
+    mooon::net::CSendMachine<CConnector> send_machine2(&connector);
+    send_machine2.set_watermarks(100000, 10000, &observer2);
+    budget->set_limit(budget->get_bytes() + 30000);
+    send_machine2.push(chunk.data(), chunk.size());
+    const bool paused = send_machine2.is_paused() && budget->is_exceeded() && (1 == observer2.high_number);
+    send_machine2.reset(false);
+    budget->set_limit(0);
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("watermarks: high=%d low=%d, budget paused=%d\n", observer.high_number, observer.low_number, paused? 1: 0);
+    return paused && (1 == observer2.low_number) && !send_machine2.is_paused() && (0 == budget->get_paused_number());
+}
+
+int main()
+{
+    if (!test_partial_write())
+        return 1;
+    if (!test_zerocopy())
+        return 1;
+    if (!test_watermarks())
+        return 1;
+
+    printf("send machine ok\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "mooon/net/event_loop.h"
+#include "mooon/net/signal_fd.h"
+#include "mooon/sys/utils.h"
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+using namespace mooon;
+
+class CSignalObserver: public sys::ISignalObserver
+{
+public:
+    CSignalObserver()
+        : terminated(0), child_ended(0), usr2_number(0), shared_loop(NULL)
+    {
+    }
+
+    virtual void on_terminated()
+    {
+        __atomic_add_fetch(&terminated, 1, __ATOMIC_RELEASE);
+    }
+
+    virtual void on_child_end(pid_t child_pid, int child_exited_status)
+    {
+        if (WIFEXITED(child_exited_status) && (3 == WEXITSTATUS(child_exited_status)))
+            __atomic_add_fetch(&child_ended, 1, __ATOMIC_RELEASE);
+    }
+
+    virtual void on_signal_handler(int signo)
+    {
+        // 回调在循环线程中执行
+        if ((SIGUSR2 == signo) && (shared_loop != NULL) && shared_loop->in_loop_thread())
+            __atomic_add_fetch(&usr2_number, 1, __ATOMIC_RELEASE);
+    }
+
+public:
+    int terminated;
+    int child_ended;
+    int usr2_number;
+    net::CEventLoop* shared_loop;
+};
+
+static bool wait_for(const int* value, int expected)
+{
+    for (int i=0; i<200; ++i)
+    {
+        if (__atomic_load_n(value, __ATOMIC_ACQUIRE) >= expected)
+            return true;
+        sys::CUtils::millisleep(5);
+    }
+    return false;
+}
+
+// 没有加入循环时直接读
+static bool test_read_signals()
+{
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL) != 0)
+        return false;
+
+    net::CSignalFd signal_fd(NULL);
+    signal_fd.create(sigset);
+
+    struct signalfd_siginfo siginfos[4];
+    if (signal_fd.read_signals(siginfos, 4) != 0)
+        return false;
+    kill(getpid(), SIGUSR1);
+    const int number = signal_fd.read_signals(siginfos, 4);
+    printf("read_signals: %d signal(s), first is %u\n", number, (number > 0)? siginfos[0].ssi_signo: 0);
+    return (1 == number) && (SIGUSR1 == siginfos[0].ssi_signo);
+}
+
+int main()
+{
+    try
+    {
+        if (!test_read_signals())
+            return 1;
+
+        // 须在创建循环线程之前阻塞
+        sys::CSignalHandler::block_signal(SIGTERM);
+        sys::CSignalHandler::block_signal(SIGCHLD);
+        sys::CSignalHandler::block_signal(SIGUSR2);
+
+        CSignalObserver observer;
+        net::CReactorPool reactor_pool;
+        reactor_pool.create(1, 100, false);
+        observer.shared_loop = reactor_pool.get_loop(0);
+
+        net::CSignalFd* signal_fd = new net::CSignalFd(&observer);
+        signal_fd->create();
+        observer.shared_loop->post_add(signal_fd, EPOLLIN);
+        sys::CUtils::millisleep(20);
+
+        kill(getpid(), SIGUSR2);
+        if (!wait_for(&observer.usr2_number, 1))
+        {
+            fprintf(stderr, "SIGUSR2 not dispatched\n");
+            return 1;
+        }
+
+        const pid_t child_pid = fork();
+        if (0 == child_pid)
+            _exit(3);
+        if (!wait_for(&observer.child_ended, 1))
+        {
+            fprintf(stderr, "SIGCHLD not dispatched\n");
+            return 1;
+        }
+
+        kill(getpid(), SIGTERM);
+        if (!wait_for(&observer.terminated, 1))
+        {
+            fprintf(stderr, "SIGTERM not dispatched\n");
+            return 1;
+        }
+
+        reactor_pool.destroy();
+        printf("usr2: %d, child: %d, terminated: %d\n", observer.usr2_number, observer.child_ended, observer.terminated);
+        printf("signal fd ok\n");
+        return 0;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+}
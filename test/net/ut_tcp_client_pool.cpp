@@ -0,0 +1,125 @@
+#include "mooon/net/tcp_client_pool.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <vector>
+using namespace mooon;
+
+// 监听本机任意端口，返回监听的端口号
+static int listen_loopback(uint16_t* port)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 16))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+    {
+        close(listen_fd);
+        return -1;
+    }
+
+    *port = ntohs(addr.sin_port);
+    net::set_nonblock(listen_fd, true);
+    return listen_fd;
+}
+
+static void accept_all(int listen_fd, std::vector<int>* fds)
+{
+    int fd;
+    while ((fd = accept(listen_fd, NULL, NULL)) != -1)
+        fds->push_back(fd);
+}
+
+static void close_all(std::vector<int>* fds)
+{
+    for (std::vector<int>::size_type i=0; i<fds->size(); ++i)
+        close((*fds)[i]);
+    fds->clear();
+}
+
+int main()
+{
+    try
+    {
+        uint16_t port;
+        int listen_fd = listen_loopback(&port);
+        if (-1 == listen_fd)
+            return 1;
+
+        net::CReactorPool reactor_pool;
+        reactor_pool.create(1, 100, false);
+
+        const net::ip_node_t ip_node(port, net::ip_address_t("127.0.0.1"));
+        net::CTcpClientPool client_pool(reactor_pool.get_loop(0), 2, 2, 4);
+        client_pool.create(4, 20);
+        client_pool.add_node(ip_node);
+
+        // 第一次借用等待事件循环中的连接完成
+        net::CTcpClient* client = client_pool.borrow(ip_node, 1000);
+        if ((NULL == client) || !client->is_connect_established())
+            return 1;
+        size_t size = 4;
+        client->full_send("ping", size);
+
+        // 归还后再借，复用同一个连接，不再握手
+        client_pool.pay_back(client);
+        net::CTcpClient* again = client_pool.borrow(ip_node);
+        if (again != client)
+            return 1;
+        client_pool.pay_back(again);
+        sys::CUtils::millisleep(100);
+
+        std::vector<int> server_fds;
+        accept_all(listen_fd, &server_fds);
+        printf("connect: %" PRIu64 ", reuse: %" PRIu64 ", idle: %u, accepted: %zu\n",
+               client_pool.get_connect_number(), client_pool.get_reuse_number(),
+               client_pool.get_idle_number(ip_node), server_fds.size());
+        if ((client_pool.get_connect_number() != 2) || (server_fds.size() != 2) || (client_pool.get_idle_number(ip_node) != 2))
+            return 1;
+
+        // 对端关闭后，健康检查剔除空闲连接并补足
+        close_all(&server_fds);
+        sys::CUtils::millisleep(200);
+        printf("evict: %" PRIu64 ", connect: %" PRIu64 ", idle: %u\n",
+               client_pool.get_evict_number(), client_pool.get_connect_number(), client_pool.get_idle_number(ip_node));
+        if ((client_pool.get_evict_number() != 2) || (client_pool.get_connect_number() != 4) || (client_pool.get_idle_number(ip_node) != 2))
+            return 1;
+
+        // 连接数不超过max_connections
+        std::vector<net::CTcpClient*> clients;
+        while ((client = client_pool.borrow(ip_node, 200)) != NULL)
+            clients.push_back(client);
+        if ((clients.size() != 4) || (client_pool.get_connection_number(ip_node) != 4))
+            return 1;
+        for (std::vector<net::CTcpClient*>::size_type i=0; i<clients.size(); ++i)
+            client_pool.pay_back(clients[i], 0 == i);
+        if ((client_pool.get_idle_number(ip_node) != 2) || (client_pool.get_connection_number(ip_node) != 2))
+            return 1;
+
+        // 连接不上的节点
+        accept_all(listen_fd, &server_fds);
+        close_all(&server_fds);
+        close(listen_fd);
+        const net::ip_node_t refused_node(1, net::ip_address_t("127.0.0.1"));
+        if (client_pool.borrow(refused_node, 200) != NULL)
+            return 1;
+        printf("failure: %" PRIu64 "\n", client_pool.get_connect_failure_number());
+        if (0 == client_pool.get_connect_failure_number())
+            return 1;
+
+        client_pool.destroy();
+        reactor_pool.destroy();
+
+        printf("tcp client pool ok\n");
+        return 0;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+}
@@ -0,0 +1,281 @@
+#include "mooon/net/listener.h"
+#include "mooon/net/tcp_client.h"
+#include "mooon/sys/clock.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+using namespace mooon;
+
+// 得到一个未被监听的端口，连接它会被拒绝
+static uint16_t get_closed_port()
+{
+    net::CListener listener;
+    listener.listen(net::ip_address_t("127.0.0.1"), 0, false);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    (void)getsockname(listener.get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    return ntohs(addr.sin_port);
+}
+
+static uint16_t get_listen_port(net::CListener* listener)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    (void)getsockname(listener->get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    return ntohs(addr.sin_port);
+}
+
+// 请求的第一段数据到达服务端，服务端原样返回
+static bool echo(net::CTcpClient* client, net::CListener* listener)
+{
+    size_t size = 5;
+    client->full_send("hello", size);
+    net::ip_address_t peer_ip;
+    uint16_t peer_port;
+    int fd = listener->accept(peer_ip, peer_port);
+    char buffer[16];
+    const bool ok = (recv(fd, buffer, 5, MSG_WAITALL) == 5) && (send(fd, buffer, 5, 0) == 5);
+    ::close(fd);
+
+    size = 5;
+    return ok && client->full_receive(buffer, size) && (0 == memcmp(buffer, "hello", 5));
+}
+
+static bool test_fast_open()
+{
+    net::CListener listener;
+    listener.listen(net::ip_address_t("127.0.0.1"), 0, false);
+    listener.enable_fast_open(16);
+    const uint16_t port = get_listen_port(&listener);
+
+    // 第一次取得cookie，之后（服务端开启时）数据随SYN发出
+    for (int i=0; i<2; ++i)
+    {
+        net::CTcpClient client;
+        client.set_fast_open(true);
+        client.set_peer(net::ip_node_t(port, net::ip_address_t("127.0.0.1")));
+        client.set_connect_timeout_milliseconds(1000);
+        client.timed_connect();
+        if (!echo(&client, &listener))
+            return false;
+
+        int enabled = 0;
+        socklen_t length = sizeof(enabled);
+        if ((-1 == getsockopt(client.get_fd(), IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enabled, &length)) || (enabled != 1))
+        {
+            printf("TCP_FASTOPEN_CONNECT not supported\n");
+            return true;
+        }
+
+        struct tcp_info info;
+        length = sizeof(info);
+        (void)getsockopt(client.get_fd(), IPPROTO_TCP, TCP_INFO, &info, &length);
+        printf("fast open %d: syn data %s\n", i, (info.tcpi_options & TCPI_OPT_SYN_DATA)? "acked": "not acked");
+    }
+    return true;
+}
+
+static bool test_race()
+{
+    net::CListener listener;
+    listener.listen(net::ip_address_t("127.0.0.1"), 0, false);
+    const uint16_t port = get_listen_port(&listener);
+    const uint16_t closed_port = get_closed_port();
+
+    // 前一个被拒绝后立即尝试下一个，不等待错开的时长
+    std::vector<net::ip_node_t> candidates;
+    candidates.push_back(net::ip_node_t(closed_port, net::ip_address_t("127.0.0.1")));
+    candidates.push_back(net::ip_node_t(port, net::ip_address_t("127.0.0.1")));
+    net::CTcpClient client;
+    client.set_connect_timeout_milliseconds(1000);
+    const uint64_t start = sys::CClock::get_milliseconds();
+    client.race_connect(candidates, 500);
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - start;
+    printf("race: connected to %s in %" PRIu64"ms\n", client.to_string().c_str(), milliseconds);
+    if (!client.is_connect_established() || (client.get_peer_port() != port) || (milliseconds >= 500) || !echo(&client, &listener))
+        return false;
+
+    // 全部失败时抛出最后一个失败的原因
+    candidates.pop_back();
+    candidates.push_back(net::ip_node_t(closed_port, net::ip_address_t("127.0.0.2")));
+    net::CTcpClient client2;
+    try
+    {
+        client2.race_connect(candidates, 100);
+        return false;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("race expected: %s\n", ex.str().c_str());
+        if (ex.errcode() != ECONNREFUSED)
+            return false;
+    }
+
+    candidates.clear();
+    try
+    {
+        client2.race_connect(candidates);
+        return false;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        return EINVAL == ex.errcode();
+    }
+}
+
+// 绑定的本端IP生效，整个127.0.0.0/8都是本机地址，端口仍由内核在connect时分配
+static bool test_local_ip()
+{
+    net::CListener listener;
+    listener.listen(net::ip_address_t("127.0.0.1"), 0, false);
+    const uint16_t port = get_listen_port(&listener);
+
+    net::CTcpClient client;
+    client.set_local_ip(net::ip_address_t("127.0.0.2"));
+    client.set_peer(net::ip_node_t(port, net::ip_address_t("127.0.0.1")));
+    client.set_connect_timeout_milliseconds(1000);
+    client.timed_connect();
+
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    (void)getsockname(client.get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    printf("local: %s:%u\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    if ((addr.sin_addr.s_addr != inet_addr("127.0.0.2")) || (0 == addr.sin_port) || !echo(&client, &listener))
+        return false;
+
+    // 本机没有的地址绑定失败
+    net::CTcpClient client2;
+    client2.set_local_ip(net::ip_address_t("192.0.2.1"));
+    client2.set_peer(net::ip_node_t(port, net::ip_address_t("127.0.0.1")));
+    try
+    {
+        (void)client2.async_connect();
+        return false;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        if ((ex.errcode() != EADDRNOTAVAIL) || (client2.get_fd() != -1))
+            return false;
+    }
+
+    // 不同为IPV4或IPV6时不绑定
+    client2.set_local_ip(net::ip_address_t("::1"));
+    client2.set_connect_timeout_milliseconds(1000);
+    client2.timed_connect();
+    return echo(&client2, &listener);
+}
+
+// 每30毫秒发送一个字节，共发送count个后关闭连接
+struct TrickleContext
+{
+    int fd;
+    int count;
+};
+
+static void* trickle(void* param)
+{
+    TrickleContext* context = static_cast<TrickleContext*>(param);
+    for (int i=0; i<context->count; ++i)
+    {
+        usleep(30000);
+        if (send(context->fd, "x", 1, MSG_NOSIGNAL) != 1)
+            break;
+    }
+    ::close(context->fd);
+    return NULL;
+}
+
+static uint64_t elapsed_milliseconds(uint64_t start_nanoseconds)
+{
+    return (sys::CClock::get_nanoseconds() - start_nanoseconds) / 1000000;
+}
+
+// 对端不停地一点点发送，按每次poll计的超时永远不会到，截止时间则限定了整个接收
+static bool test_deadline()
+{
+    net::CListener listener;
+    listener.listen(net::ip_address_t("127.0.0.1"), 0, false);
+    const uint16_t port = get_listen_port(&listener);
+
+    for (int round=0; round<4; ++round)
+    {
+        net::CTcpClient client;
+        client.set_peer(net::ip_node_t(port, net::ip_address_t("127.0.0.1")));
+        client.set_connect_timeout_milliseconds(1000);
+        client.timed_connect();
+
+        net::ip_address_t peer_ip;
+        uint16_t peer_port;
+        TrickleContext context = { listener.accept(peer_ip, peer_port), (3 == round)? 3: 100 };
+        pthread_t thread;
+        pthread_create(&thread, NULL, trickle, &context);
+
+        char buffer[100];
+        size_t size = sizeof(buffer);
+        const uint64_t start = sys::CClock::get_nanoseconds();
+        int errcode = 0;
+        bool received = true;
+        try
+        {
+            if (0 == round)
+            {
+                size = client.timed_receive(buffer, sizeof(buffer), 200);
+            }
+            else if (1 == round)
+            {
+                received = client.full_receive(buffer, size, sys::CDeadline(200));
+            }
+            else if (2 == round)
+            {
+                sys::CDeadlineScope scope(sys::CDeadline(200));
+                received = client.full_receive(buffer, size);
+            }
+            else
+            {
+                // 截止之前对端关闭
+                received = client.full_receive(buffer, size, sys::CDeadline(2000));
+            }
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            errcode = ex.errcode();
+        }
+
+        const uint64_t milliseconds = elapsed_milliseconds(start);
+        printf("deadline round %d: size=%zu, errcode=%d, received=%d, %" PRIu64 "ms\n", round, size, errcode, received, milliseconds);
+        client.close();
+        pthread_join(thread, NULL);
+
+        if ((3 == round)? ((size != 3) || received || (errcode != 0)): ((size >= sizeof(buffer)) || (0 == size) || (milliseconds < 190) || (milliseconds > 600)))
+            return false;
+        if (((1 == round) || (2 == round)) && (errcode != ETIMEDOUT))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_fast_open())
+            return 1;
+        if (!test_race())
+            return 1;
+        if (!test_local_ip())
+            return 1;
+        if (!test_deadline())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("tcp connect ok\n");
+    return 0;
+}
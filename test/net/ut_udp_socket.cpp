@@ -0,0 +1,162 @@
+#include "mooon/net/udp_socket.h"
+#include "mooon/net/utils.h"
+#include <arpa/inet.h>
+#include <poll.h>
+MOOON_NAMESPACE_USE
+
+#define MESSAGE_NUMBER 100
+
+// 得到绑定的本机地址
+static struct sockaddr_in get_local_addr(net::CUdpSocket* udp_socket)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    (void)getsockname(udp_socket->get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    return addr;
+}
+
+// 接收到共expected个消息（GRO合并的按分段计）或超时为止，返回收到的个数
+static uint32_t receive_all(net::CUdpSocket* udp_socket, net::CUdpMessageArena* arena, uint32_t expected, uint32_t* syscalls)
+{
+    uint32_t received = 0;
+    *syscalls = 0;
+
+    while (received < expected)
+    {
+        int number;
+        try
+        {
+            number = udp_socket->timed_receive_batch(arena, 1000);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            break;
+        }
+
+        ++*syscalls;
+        for (int i=0; i<number; ++i)
+        {
+            const uint16_t segment_size = arena->get_segment_size(i);
+            received += (0 == segment_size)? 1: (arena->get_size(i)+segment_size-1) / segment_size;
+        }
+    }
+
+    return received;
+}
+
+int main()
+{
+    try
+    {
+        net::CUdpSocket receiver, sender;
+        receiver.listen("127.0.0.1", 0, true);
+        sender.listen("127.0.0.1", 0);
+        const struct sockaddr_in to_addr = get_local_addr(&receiver);
+        const struct sockaddr_in from_addr = get_local_addr(&sender);
+
+        // sendmmsg批量发送，recvmmsg批量接收
+        net::CUdpMessageArena send_arena(32, 64);
+        uint32_t sent = 0;
+        while (sent < MESSAGE_NUMBER)
+        {
+            send_arena.clear();
+            for (; (sent < MESSAGE_NUMBER) && (send_arena.get_number() < send_arena.get_capacity()); ++sent)
+            {
+                char message[64];
+                int size = snprintf(message, sizeof(message), "message%u", sent);
+                if (!send_arena.add(message, size, to_addr))
+                    return 1;
+            }
+            if ((send_arena.get_number() == send_arena.get_capacity()) && send_arena.add("x", 1, to_addr)) // 槽位已用完
+                return 1;
+
+            for (uint32_t offset=0; offset<send_arena.get_number();)
+                offset += sender.send_batch(&send_arena, offset);
+        }
+
+        net::CUdpMessageArena receive_arena(16, 64);
+        uint32_t received = 0, syscalls = 0;
+        while (received < MESSAGE_NUMBER)
+        {
+            // 回环的投递可能推迟到软中断中，先等到可读
+            if (!net::CUtils::timed_poll(receiver.get_fd(), POLLIN, 1000))
+                return 1;
+            const int number = receiver.receive_batch(&receive_arena);
+            if (number <= 0)
+                return 1;
+
+            ++syscalls;
+            for (int i=0; i<number; ++i, ++received)
+            {
+                char message[64];
+                int size = snprintf(message, sizeof(message), "message%u", received);
+                if ((receive_arena.get_size(i) != static_cast<size_t>(size))
+                 || (0 != memcmp(receive_arena.get_data(i), message, size))
+                 || (receive_arena.get_addr(i).sin_port != from_addr.sin_port))
+                    return 1;
+            }
+        }
+        printf("batch: %u messages in %u syscalls\n", received, syscalls);
+        if ((syscalls >= MESSAGE_NUMBER) || (receiver.receive_batch(&receive_arena) != -1))
+            return 1;
+
+        // 接收时间戳，回环上也有软件时间戳，单个和批量接收都能取到
+        if (receiver.enable_timestamping())
+        {
+            char message[64];
+            struct sockaddr_in addr;
+            struct timespec timestamp;
+            sender.send_to("ts", 2, to_addr);
+            sender.send_to("ts", 2, to_addr);
+            if (!net::CUtils::timed_poll(receiver.get_fd(), POLLIN, 1000)
+             || (receiver.receive_from(message, sizeof(message), &addr, &timestamp) != 2) || (0 == timestamp.tv_sec))
+                return 1;
+            const int64_t latency = net::get_timestamp_latency_nanoseconds(timestamp);
+            if (!net::CUtils::timed_poll(receiver.get_fd(), POLLIN, 1000)
+             || (receiver.receive_batch(&receive_arena) != 1) || !receive_arena.get_timestamp(0, &timestamp))
+                return 1;
+            printf("timestamping: latency %" PRId64 "ns\n", latency);
+            if ((latency < 0) || (latency > 1000000000))
+                return 1;
+        }
+
+        // 无CAP_NET_ADMIN权限时增大忙轮询时长会失败
+        printf("busy poll: %s\n", receiver.set_busy_poll(50, true)? "on": "not permitted");
+
+        // GSO：一次发送按100字节切分成10个消息，开启GRO时接收端可能又合并成一个
+        char buffer[1000];
+        memset(buffer, 'g', sizeof(buffer));
+        try
+        {
+            sender.send_gso(buffer, sizeof(buffer), 100, to_addr);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            printf("GSO not supported, skipped: %s\n", ex.str().c_str());
+            printf("udp socket ok\n");
+            return 0;
+        }
+
+        received = receive_all(&receiver, &receive_arena, 10, &syscalls);
+        printf("gso: %u messages in %u syscalls\n", received, syscalls);
+        if (received != 10)
+            return 1;
+
+        net::CUdpMessageArena gro_arena(4, 65535);
+        const bool gro = receiver.enable_gro(true);
+        sender.send_gso(buffer, sizeof(buffer), 100, to_addr);
+        received = receive_all(&receiver, &gro_arena, 10, &syscalls);
+        printf("gro(%s): %u messages, first size %zu, segment size %u\n",
+               gro? "on": "off", received, gro_arena.get_size(0), gro_arena.get_segment_size(0));
+        if (received != 10)
+            return 1;
+
+        printf("udp socket ok\n");
+        return 0;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+}
@@ -0,0 +1,182 @@
+#include "mooon/net/event_loop.h"
+#include "mooon/net/send_machine.h"
+#include "mooon/net/tcp_client.h"
+#include "mooon/net/write_coalescer.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <poll.h>
+using namespace mooon;
+
+static bool connect_loopback(net::CTcpClient* client, int* server_fd)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 1))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+    {
+        close(listen_fd);
+        return false;
+    }
+
+    client->set_peer(net::ip_node_t(ntohs(addr.sin_port), net::ip_address_t("127.0.0.1")));
+    client->set_connect_timeout_milliseconds(1000);
+    client->timed_connect();
+    *server_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    return *server_fd != -1;
+}
+
+// 等待milliseconds毫秒内到达的数据，返回收到的字节数
+static ssize_t receive_within(int fd, char* buffer, size_t buffer_size, int milliseconds)
+{
+    struct pollfd fds = { fd, POLLIN, 0 };
+    if (poll(&fds, 1, milliseconds) <= 0)
+        return 0;
+    return recv(fd, buffer, buffer_size, MSG_DONTWAIT);
+}
+
+// 批中的小块被攒住，flush后一起到达
+static bool test_policy(net::CWriteCoalescer::coalesce_policy_t policy)
+{
+    net::CTcpClient client;
+    int server_fd;
+    if (!connect_loopback(&client, &server_fd))
+        return false;
+    client.set_nodelay(true);
+    if (!client.is_nodelay())
+        return false;
+
+    net::CWriteCoalescer coalescer(&client, NULL, policy);
+    net::CSendMachine<net::CTcpClient> send_machine(&client);
+    send_machine.set_coalescer(&coalescer);
+    for (int i=0; i<10; ++i)
+    {
+        send_machine.push("0123456789", 10);
+        if (send_machine.continue_send() != utils::handle_finish)
+            return false;
+    }
+
+    char buffer[1024];
+    ssize_t bytes = receive_within(server_fd, buffer, sizeof(buffer), 50);
+    if (!coalescer.is_batching() || (bytes != 0))
+    {
+        printf("policy %d: %zd bytes before flush\n", policy, bytes);
+        return false;
+    }
+
+    coalescer.flush();
+    bytes = receive_within(server_fd, buffer, sizeof(buffer), 50);
+    printf("policy %d: %zd bytes after flush\n", policy, bytes);
+    close(server_fd);
+    return (100 == bytes) && !coalescer.is_batching() && (1 == coalescer.get_flush_number());
+}
+
+// 低延迟模式下不合并
+static bool test_low_latency()
+{
+    net::CTcpClient client;
+    int server_fd;
+    if (!connect_loopback(&client, &server_fd))
+        return false;
+
+    net::CWriteCoalescer coalescer(&client);
+    coalescer.begin();
+    size_t size = 5;
+    client.full_send("hello", size);
+    coalescer.set_low_latency(true);
+    coalescer.begin();
+    size = 5;
+    client.full_send("world", size);
+
+    char buffer[1024];
+    ssize_t bytes = receive_within(server_fd, buffer, sizeof(buffer), 50);
+    close(server_fd);
+    return (10 == bytes) && !coalescer.is_batching();
+}
+
+// 在事件循环中开始的批，在本轮结束时自动flush
+class CSendTask: public net::ILoopTask
+{
+public:
+    CSendTask(net::CTcpClient* client, net::CWriteCoalescer* coalescer, sys::CLock* lock, sys::CEvent* event)
+        : _client(client), _coalescer(coalescer), _lock(lock), _event(event)
+    {
+    }
+
+private:
+    virtual void execute(net::CEventLoop* event_loop)
+    {
+        _coalescer->set_event_loop(event_loop);
+        for (int i=0; i<3; ++i)
+        {
+            _coalescer->begin();
+            size_t size = 4;
+            _client->full_send("ping", size);
+        }
+
+        sys::LockHelper<sys::CLock> lock_helper(*_lock);
+        _event->signal();
+    }
+
+private:
+    net::CTcpClient* _client;
+    net::CWriteCoalescer* _coalescer;
+    sys::CLock* _lock;
+    sys::CEvent* _event;
+};
+
+static bool test_event_loop()
+{
+    net::CTcpClient client;
+    int server_fd;
+    if (!connect_loopback(&client, &server_fd))
+        return false;
+
+    net::CReactorPool reactor_pool;
+    reactor_pool.create(1, 100, false);
+    net::CWriteCoalescer coalescer(&client);
+    sys::CEvent event;
+    sys::CLock lock;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(lock);
+        reactor_pool.get_loop(0)->post(new CSendTask(&client, &coalescer, &lock, &event));
+        event.wait(lock);
+    }
+
+    char buffer[1024];
+    ssize_t bytes = receive_within(server_fd, buffer, sizeof(buffer), 100);
+    reactor_pool.destroy();
+    close(server_fd);
+    printf("event loop: %zd bytes, %" PRIu64 " flush\n", bytes, coalescer.get_flush_number());
+    return (12 == bytes) && (1 == coalescer.get_flush_number());
+}
+
+int main()
+{
+    try
+    {
+        if (!test_policy(net::CWriteCoalescer::coalesce_cork))
+            return 1;
+        if (!test_policy(net::CWriteCoalescer::coalesce_more))
+            return 1;
+        if (!test_low_latency())
+            return 1;
+        if (!test_event_loop())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("write coalescer ok\n");
+    return 0;
+}
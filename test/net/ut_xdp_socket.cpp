@@ -0,0 +1,81 @@
+#include "mooon/net/xdp_socket.h"
+#include "mooon/sys/utils.h"
+#include <arpa/inet.h>
+#include <string.h>
+MOOON_NAMESPACE_USE
+
+#define MESSAGE_NUMBER 100
+
+// 得到绑定的本机地址
+static struct sockaddr_in get_local_addr(net::CUdpSocket* udp_socket)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    (void)getsockname(udp_socket->get_fd(), reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    return addr;
+}
+
+int main()
+{
+    try
+    {
+        // 在回环网卡上以通用模式尝试AF_XDP，无权限或不支持时退回普通套接字，两种情况下收到的消息都相同
+        net::CUdpSocket probe;
+        probe.listen("127.0.0.1", 0);
+        const uint16_t port = ntohs(get_local_addr(&probe).sin_port);
+        probe.close();
+
+        net::CUdpIngress ingress;
+        const bool xdp = ingress.create("127.0.0.1", port, "lo", 0, true);
+        printf("AF_XDP %s (supported: %s)\n", xdp? "enabled": "unavailable", net::CXdpSocket::is_supported()? "yes": "no");
+
+        net::CUdpSocket sender;
+        sender.listen("127.0.0.1", 0);
+        const uint16_t from_port = get_local_addr(&sender).sin_port;
+        for (int i=0; i<MESSAGE_NUMBER; ++i)
+        {
+            char message[64];
+            const int size = snprintf(message, sizeof(message), "message%d", i);
+            sender.send_to(message, size, "127.0.0.1", port);
+        }
+
+        net::CUdpMessageArena arena(16, 2048);
+        int received = 0;
+        for (int k=0; (k<1000) && (received<MESSAGE_NUMBER); ++k)
+        {
+            const int number = ingress.receive_batch(&arena);
+            if (number < 0)
+            {
+                sys::CUtils::millisleep(1);
+                continue;
+            }
+
+            for (int i=0; i<number; ++i, ++received)
+            {
+                char message[64];
+                const int size = snprintf(message, sizeof(message), "message%d", received);
+                if ((arena.get_size(i) != static_cast<size_t>(size)) || (0 != memcmp(arena.get_data(i), message, size))
+                 || (arena.get_addr(i).sin_port != from_port) || (arena.get_addr(i).sin_addr.s_addr != inet_addr("127.0.0.1")))
+                {
+                    printf("mismatch at %d: %.*s\n", received, static_cast<int>(arena.get_size(i)), arena.get_data(i));
+                    return 1;
+                }
+            }
+        }
+
+        printf("received %d messages (expected %d)", received, MESSAGE_NUMBER);
+        if (xdp)
+            printf(", dropped %" PRIu64 "/%" PRIu64, ingress.get_xdp_socket()->get_dropped_number(), ingress.get_xdp_socket()->get_kernel_dropped_number());
+        printf("\n");
+        if (MESSAGE_NUMBER != received)
+            return 1;
+
+        // 被XDP程序转走的包不再经过内核协议栈
+        return (xdp && (ingress.get_udp_socket()->receive_batch(&arena) != -1))? 1: 0;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+}
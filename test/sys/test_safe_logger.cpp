@@ -44,6 +44,7 @@ INTEGER_ARG_DEFINE(int, lines, 10000, 1, 100000000, "number of lines");
 INTEGER_ARG_DEFINE(uint32_t, size, 1024*1024*800, 1024, 1024*1024*2000, "size of a single log file");
 INTEGER_ARG_DEFINE(uint16_t, backup, 1000, 1, 10000, "backup number of log file");
 INTEGER_ARG_DEFINE(uint8_t, enable_syslog, 0, 0, 1, "enable write syslog when error");
+INTEGER_ARG_DEFINE(uint8_t, async, 0, 0, 1, "write log asynchronously");
 STRING_ARG_DEFINE(suffix, "", "suffix of log filename");
 MOOON_NAMESPACE_USE
 
@@ -103,7 +104,8 @@ int main(int argc, char* argv[])
     try
     {
         pid_t pid;
-        ::mooon::sys::g_logger = sys::create_safe_logger(true, SIZE_8K, argument::suffix->value(), 1==mooon::argument::enable_syslog->value());
+        sys::CSafeLogger* safe_logger = sys::create_safe_logger(true, SIZE_8K, argument::suffix->value(), 1==mooon::argument::enable_syslog->value());
+        ::mooon::sys::g_logger = safe_logger;
         sys::g_logger->set_single_filesize(argument::size->value());
         sys::g_logger->set_backup_number(argument::backup->value());
         sys::g_logger->set_log_level(sys::LOG_LEVEL_DETAIL);
@@ -123,7 +125,9 @@ int main(int argc, char* argv[])
             }
             else if (0 == pid)
             {
-                // 子进程
+                // 子进程，后台线程不会被fork，所以在fork之后才开启异步
+                if (1 == argument::async->value())
+                    safe_logger->enable_async();
                 sys::CThreadEngine** threads = new sys::CThreadEngine*[argument::threads->value()];
 
                 for (int i=0; i<argument::threads->value(); ++i)
@@ -139,6 +143,7 @@ int main(int argc, char* argv[])
 
                 if (argument::processes->value() > 1)
                 {
+                    safe_logger->flush();
                     exit(0);
                 }
             }
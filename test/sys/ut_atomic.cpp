@@ -0,0 +1,128 @@
+#include "mooon/sys/atomic.h"
+#include "mooon/sys/atomic128.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+using namespace mooon;
+
+#define THREAD_NUMBER 4
+#define LOOP_NUMBER   200000
+#define NODE_NUMBER   64
+
+struct Node
+{
+    Node* next;
+    int owner; // 被哪个线程弹出，-1表示在栈中
+};
+
+static sys::CTaggedPointer<Node> sg_top;
+static sys::CPerCpuCounter sg_counter;
+static sys::CAtomic<int> sg_errors;
+
+static Node* pop()
+{
+    sys::CTaggedPointer<Node>::tagged_t top = sg_top.load();
+    while ((top.pointer != NULL) && !sg_top.compare_exchange(top, top.pointer->next));
+    return top.pointer;
+}
+
+static void push(Node* node)
+{
+    sys::CTaggedPointer<Node>::tagged_t top = sg_top.load();
+    do
+    {
+        node->next = top.pointer;
+    } while (!sg_top.compare_exchange(top, node));
+}
+
+// 反复弹出再压回，没有版本号时容易因ABA把同一节点弹出两次或丢失节点
+static void* stack_thread(void* param)
+{
+    const int index = static_cast<int>(reinterpret_cast<long>(param));
+    for (int i=0; i<LOOP_NUMBER; ++i)
+    {
+        Node* node = pop();
+        if (node != NULL)
+        {
+            if (node->owner != -1)
+                sg_errors.fetch_add(1, sys::atomic_relaxed);
+            node->owner = index;
+            sg_counter.add();
+            node->owner = -1;
+            push(node);
+        }
+    }
+
+    return NULL;
+}
+
+static bool test_order()
+{
+    sys::CAtomic<int> value(1);
+    int expected = 2;
+    if (value.compare_exchange(expected, 3, sys::atomic_acq_rel) || (1 != expected))
+        return false;
+    if (!value.compare_exchange(expected, 3, sys::atomic_release) || (3 != value.load(sys::atomic_acquire)))
+        return false;
+    if ((3 != value.fetch_add(2, sys::atomic_relaxed)) || (5 != value.fetch_sub(1)))
+        return false;
+    value.store(10, sys::atomic_release);
+
+    sys::CAtomic<int64_t> value64(INT64_C(1) << 40);
+    int64_t expected64 = INT64_C(1) << 40;
+    return (10 == value.get_value()) && value64.compare_exchange(expected64, 7, sys::atomic_relaxed) && (7 == value64.load(sys::atomic_relaxed));
+}
+
+static bool test_cas128()
+{
+    sys::atomic128_t target = { 1, 2 };
+    sys::atomic128_t expected = { 1, 3 };
+    sys::atomic128_t desired = { 4, 5 };
+    if (sys::atomic_cas128(&target, &expected, desired) || (1 != expected.low) || (2 != expected.high))
+        return false;
+    if (!sys::atomic_cas128(&target, &expected, desired) || (4 != target.low) || (5 != target.high))
+        return false;
+
+    const sys::atomic128_t value = sys::atomic_load128(&target);
+    return (4 == value.low) && (5 == value.high);
+}
+
+int main()
+{
+    if (!test_order())
+    {
+        printf("order FAILURE\n");
+        return 1;
+    }
+    if (!test_cas128())
+    {
+        printf("cas128 FAILURE\n");
+        return 1;
+    }
+
+    std::vector<Node> nodes(NODE_NUMBER);
+    for (int i=0; i<NODE_NUMBER; ++i)
+    {
+        nodes[i].owner = -1;
+        push(&nodes[i]);
+    }
+
+    pthread_t threads[THREAD_NUMBER];
+    for (long i=0; i<THREAD_NUMBER; ++i)
+        pthread_create(&threads[i], NULL, stack_thread, reinterpret_cast<void*>(i));
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_join(threads[i], NULL);
+
+    int node_number = 0;
+    for (Node* node=pop(); node!=NULL; node=pop())
+        ++node_number;
+    printf("nodes: %d, popped: %llu, errors: %d\n", node_number, (unsigned long long)sg_counter.get(), sg_errors.get_value());
+    if ((NODE_NUMBER != node_number) || (0 != sg_errors.get_value()) || (0 == sg_counter.get()))
+        return 1;
+
+    sg_counter.reset();
+    if (sg_counter.get() != 0)
+        return 1;
+    printf("atomic ok\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <mooon/sys/logger.h>
+#include <mooon/utils/compressor.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+int main()
+{
+    // 解析格式
+    std::string arg_types;
+    if (!mooon::sys::parse_bin_log_format("%d %5.2f %-*s %lld %%%p %zu %c", &arg_types) || (arg_types != "idisIpIi"))
+    {
+        printf("parse error: %s\n", arg_types.c_str());
+        return 1;
+    }
+    if (mooon::sys::parse_bin_log_format("%s %m", &arg_types) || mooon::sys::parse_bin_log_format("%ls", &arg_types))
+    {
+        printf("unsupported conversions not detected\n");
+        return 1;
+    }
+
+    const char* log_path = "/tmp";
+    char log_filename[sizeof("ut_bin_log_4294967295.log")];
+    char log_filepath[sizeof("/tmp/ut_bin_log_4294967295.log")];
+    snprintf(log_filename, sizeof(log_filename), "ut_bin_log_%u.log", static_cast<unsigned int>(getpid()));
+    snprintf(log_filepath, sizeof(log_filepath), "%s/%s", log_path, log_filename);
+    (void)unlink(log_filepath);
+
+    mooon::sys::CLogger* logger = new mooon::sys::CLogger;
+    logger->enable_binary_format(true);
+    logger->create(log_path, log_filename);
+    logger->set_log_level(mooon::sys::LOG_LEVEL_DEBUG);
+    mooon::sys::g_logger = logger;
+
+    for (int i=0; i<3; ++i)
+        MYLOG_STRUCT_DEBUG("i=%d, u64=%llu, d=%.2f, s=[%-*s], c=%c\n", i, static_cast<unsigned long long>(i)*10000000000ULL, i+0.5, 6, "ab", 'x'+i);
+    MYLOG_STRUCT_DETAIL("filtered by level: %d\n", 1);
+    MYLOG_STRUCT_WARN("null string: %s\n", static_cast<const char*>(NULL));
+    errno = EINVAL;
+    MYLOG_STRUCT_ERROR("formatted when logging: %m\n");
+    MYLOG_INFO("text log: %d\n", 2018);
+
+    mooon::sys::g_logger = NULL;
+    logger->destroy(); // 等日志线程写完后才返回
+
+    const char* expected[] = {
+        "[DEBUG][ut_bin_log.cpp:39]i=0, u64=0, d=0.50, s=[ab    ], c=x\n",
+        "[DEBUG][ut_bin_log.cpp:39]i=1, u64=10000000000, d=1.50, s=[ab    ], c=y\n",
+        "[DEBUG][ut_bin_log.cpp:39]i=2, u64=20000000000, d=2.50, s=[ab    ], c=z\n",
+        "[WARN][ut_bin_log.cpp:41]null string: (null)\n",
+        "[ERROR][ut_bin_log.cpp:43]formatted when logging: Invalid argument\n",
+        "[INFO][ut_bin_log.cpp:44]text log: 2018\n"
+    };
+    const size_t expected_number = sizeof(expected) / sizeof(expected[0]);
+
+    std::vector<std::string> lines;
+    mooon::sys::bin_log_header_t header;
+    mooon::sys::CBinLogReader reader;
+    reader.open(log_filepath);
+    while (reader.next(&header))
+    {
+        const std::string line = reader.get_line();
+        printf("%s", line.c_str());
+
+        // 去掉时间和线程ID，文件名只保留短名
+        std::string::size_type pos = line.find("][", line.find("][")+2);
+        std::string stripped = line.substr(pos+1);
+        pos = stripped.find("][");
+        const std::string::size_type slash = stripped.rfind('/', stripped.find(':'));
+        if (slash != std::string::npos)
+            stripped = stripped.substr(0, pos+2) + stripped.substr(slash+1);
+        lines.push_back(stripped);
+    }
+
+    // 滚动后被压缩的文件也能直接读
+    std::string data, compressed;
+    FILE* fp = fopen(log_filepath, "rb");
+    char buffer[4096];
+    for (size_t bytes; (bytes = fread(buffer, 1, sizeof(buffer), fp)) > 0;)
+        data.append(buffer, bytes);
+    fclose(fp);
+    (void)unlink(log_filepath);
+
+    const std::string gz_filepath = std::string(log_filepath) + ".gz";
+    mooon::utils::compress_data(mooon::utils::compression_gzip, data.data(), data.size(), &compressed);
+    fp = fopen(gz_filepath.c_str(), "wb");
+    fwrite(compressed.data(), 1, compressed.size(), fp);
+    fclose(fp);
+
+    size_t gz_lines = 0;
+    reader.open(gz_filepath.c_str());
+    while (reader.next(&header))
+        ++gz_lines;
+    (void)unlink(gz_filepath.c_str());
+    if (gz_lines != lines.size())
+    {
+        printf("expect %zu lines from %s, but got %zu\n", lines.size(), gz_filepath.c_str(), gz_lines);
+        return 1;
+    }
+
+    if (lines.size() != expected_number)
+    {
+        printf("expect %zu lines, but got %zu\n", expected_number, lines.size());
+        return 1;
+    }
+    for (size_t i=0; i<expected_number; ++i)
+    {
+        if (lines[i] != expected[i])
+        {
+            printf("line %zu mismatch:\n%s%s", i, lines[i].c_str(), expected[i]);
+            return 1;
+        }
+    }
+    if (reader.get_skipped_bytes() != 0)
+        return 1;
+
+    printf("bin log ok\n");
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "mooon/sys/cache.h"
+#include "mooon/sys/db_query_cache.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/exception.h"
+#include "mooon/utils/string_utils.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+using namespace mooon;
+
+typedef sys::CConcurrentCache<std::string, int> StringCache;
+
+static sys::cache_policy_t get_policy(uint32_t capacity, sys::cache_eviction_t eviction, bool tinylfu=false)
+{
+    sys::cache_policy_t policy;
+    policy.capacity = capacity;
+    policy.shard_number = 1;
+    policy.eviction = eviction;
+    policy.tinylfu = tinylfu;
+    policy.tick_milliseconds = 10;
+    return policy;
+}
+
+// 最久未访问的被淘汰
+static bool test_lru()
+{
+    StringCache cache(get_policy(3, sys::eviction_lru));
+    int value;
+    (void)cache.put("a", 1);
+    (void)cache.put("b", 2);
+    (void)cache.put("c", 3);
+    if (!cache.get("a", &value) || (1 != value))
+        return false;
+    (void)cache.put("d", 4);
+
+    sys::cache_stats_t stats;
+    cache.get_stats(&stats);
+    printf("lru: size=%zu, evictions=%" PRIu64"\n", cache.size(), stats.evictions);
+    return (3 == cache.size()) && (1 == stats.evictions) && !cache.get("b", &value) && cache.get("a", &value) && cache.get("d", &value);
+}
+
+// 有访问位的被跳过一次
+static bool test_clock()
+{
+    StringCache cache(get_policy(3, sys::eviction_clock));
+    int value;
+    (void)cache.put("a", 1);
+    (void)cache.put("b", 2);
+    (void)cache.put("c", 3);
+    (void)cache.get("a", &value);
+    (void)cache.put("d", 4);
+    if (cache.get("b", &value) || !cache.get("a", &value) || !cache.get("c", &value))
+        return false;
+
+    // 删除后环中的位置被填补
+    if (!cache.remove("a") || cache.remove("a") || (2 != cache.size()))
+        return false;
+    (void)cache.put("e", 5);
+    (void)cache.put("f", 6);
+    printf("clock: size=%zu\n", cache.size());
+    return (3 == cache.size()) && cache.get("f", &value) && (6 == value);
+}
+
+// 满时访问频率不高于被淘汰者的新键不被接纳
+static bool test_tinylfu()
+{
+    StringCache cache(get_policy(2, sys::eviction_lru, true));
+    int value;
+    (void)cache.put("a", 1);
+    (void)cache.put("b", 2);
+    for (int i=0; i<5; ++i)
+    {
+        (void)cache.get("a", &value);
+        (void)cache.get("b", &value);
+    }
+    if (cache.put("c", 3) || cache.get("c", &value))
+        return false;
+
+    // 多次访问后c比最久未访问的a更热
+    for (int i=0; i<10; ++i)
+        (void)cache.get("c", &value);
+    if (!cache.put("c", 3) || !cache.get("c", &value))
+        return false;
+
+    sys::cache_stats_t stats;
+    cache.get_stats(&stats);
+    printf("tinylfu: rejections=%" PRIu64", evictions=%" PRIu64"\n", stats.rejections, stats.evictions);
+    return (1 == stats.rejections) && (1 == stats.evictions) && !cache.get("a", &value);
+}
+
+static bool test_ttl()
+{
+    sys::cache_policy_t policy = get_policy(100, sys::eviction_lru);
+    policy.ttl_milliseconds = 1000;
+    StringCache cache(policy);
+    int value;
+
+    (void)cache.put("short", 1, 50);
+    (void)cache.put("default", 2);
+    if (!cache.get("short", &value))
+        return false;
+    sys::CUtils::millisleep(80);
+    if (cache.get("short", &value) || !cache.get("default", &value))
+        return false;
+
+    // 更新时以新的TTL重新计时
+    (void)cache.put("expire", 3, 30);
+    (void)cache.put("default", 2, 30);
+    sys::CUtils::millisleep(60);
+    const uint64_t expired = cache.expire();
+    printf("ttl: %" PRIu64" expired, size=%zu\n", expired, cache.size());
+    return (2 == expired) && (0 == cache.size());
+}
+
+struct LoadContext
+{
+    StringCache* cache;
+    int loads;
+    bool fail;
+    int value;
+    bool success;
+};
+
+struct SlowLoader
+{
+    LoadContext* context;
+
+    SlowLoader(LoadContext* context_): context(context_) {}
+
+    bool operator ()(const std::string& key, int* value) const
+    {
+        __atomic_add_fetch(&context->loads, 1, __ATOMIC_SEQ_CST);
+        sys::CUtils::millisleep(50);
+        if (context->fail)
+            THROW_EXCEPTION("load failed", -1);
+        *value = static_cast<int>(key.size());
+        return true;
+    }
+};
+
+static void* load_thread(void* param)
+{
+    LoadContext* context = static_cast<LoadContext*>(param);
+    try
+    {
+        context->success = context->cache->get_or_load("key", SlowLoader(context), &context->value);
+    }
+    catch (utils::CException& ex)
+    {
+        context->success = false;
+    }
+    return NULL;
+}
+
+// 同一个键的并发缺失只加载一次，加载失败时等待者也失败
+static bool test_single_flight()
+{
+    sys::cache_policy_t policy;
+    StringCache cache(policy, "ut");
+    const int thread_number = 8;
+    pthread_t threads[thread_number];
+    LoadContext contexts[thread_number];
+    int loads = 0;
+
+    for (int round=0; round<2; ++round)
+    {
+        const bool fail = (0 == round);
+        for (int i=0; i<thread_number; ++i)
+        {
+            contexts[i].cache = &cache;
+            contexts[i].loads = 0;
+            contexts[i].fail = fail;
+            contexts[i].value = 0;
+            contexts[i].success = false;
+            pthread_create(&threads[i], NULL, load_thread, &contexts[i]);
+        }
+
+        loads = 0;
+        for (int i=0; i<thread_number; ++i)
+        {
+            pthread_join(threads[i], NULL);
+            loads += contexts[i].loads;
+            if (fail? contexts[i].success: (!contexts[i].success || (3 != contexts[i].value)))
+                return false;
+        }
+        printf("single flight: %d loads, fail=%d\n", loads, fail);
+        if (1 != loads)
+            return false;
+    }
+
+    sys::cache_stats_t stats;
+    cache.get_stats(&stats);
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    printf("single flight: loads=%" PRIu64", shared_loads=%" PRIu64", hits=%" PRIu64"\n", stats.loads, stats.shared_loads, stats.hits);
+    return (2 == stats.loads) && (stats.shared_loads + stats.hits == 2 * (thread_number - 1))
+        && (2 == snapshot.counters["cache.ut.loads"]) && (stats.misses == snapshot.counters["cache.ut.misses"]);
+}
+
+// 不连接DB的假连接，每次查询返回一行，值为查询的次数
+class CFakeConnection: public sys::CDBConnectionBase
+{
+public:
+    static volatile int sg_query_number;
+
+public:
+    CFakeConnection()
+        : sys::CDBConnectionBase(1024)
+    {
+    }
+
+    virtual void open() { _is_established = true; }
+    virtual void close() throw () { _is_established = false; }
+    virtual void reopen() { close(); open(); }
+    virtual void ping() {}
+    virtual uint64_t update(const char* format, ...) { return 0; }
+    virtual std::string str() throw () { return "fake"; }
+
+private:
+    virtual void do_query(sys::DBTable& db_table, const char* sql, int sql_length)
+    {
+        const int number = __atomic_add_fetch(&sg_query_number, 1, __ATOMIC_SEQ_CST);
+        db_table.push_back(sys::DBRow(1, utils::CStringUtils::int_tostring(number)));
+    }
+};
+
+volatile int CFakeConnection::sg_query_number = 0;
+
+class CFakeConnectionPool: public sys::CDBConnectionPool
+{
+private:
+    virtual sys::DBConnection* create_connection()
+    {
+        return new CFakeConnection;
+    }
+};
+
+static bool test_db_query_cache()
+{
+    CFakeConnectionPool db_pool;
+    db_pool.create(2);
+    sys::CDBQueryCache query_cache(&db_pool);
+
+    std::shared_ptr<const sys::DBTable> first = query_cache.query("SELECT v FROM t");
+    std::shared_ptr<const sys::DBTable> second = query_cache.query("SELECT v FROM t");
+    if ((first != second) || (1 != CFakeConnection::sg_query_number) || ("1" != (*first)[0][0]))
+        return false;
+
+    if (!query_cache.invalidate("SELECT v FROM t"))
+        return false;
+    std::shared_ptr<const sys::DBTable> third = query_cache.query("SELECT v FROM t");
+    printf("db query cache: %d queries, value=%s\n", CFakeConnection::sg_query_number, (*third)[0][0].c_str());
+    return (2 == CFakeConnection::sg_query_number) && ("2" == (*third)[0][0]) && ("1" == (*first)[0][0]);
+}
+
+int main()
+{
+    if (!test_lru())
+        return 1;
+    if (!test_clock())
+        return 1;
+    if (!test_tinylfu())
+        return 1;
+    if (!test_ttl())
+        return 1;
+    if (!test_single_flight())
+        return 1;
+    if (!test_db_query_cache())
+        return 1;
+
+    printf("cache ok\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "mooon/sys/clock.h"
+#include "mooon/sys/stop_watch.h"
+#include "mooon/sys/time_thread.h"
+#include "mooon/sys/utils.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+using namespace mooon;
+
+static uint64_t monotonic_nanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t absolute_difference(uint64_t a, uint64_t b)
+{
+    return (a > b)? a-b: b-a;
+}
+
+static bool test_clock()
+{
+    printf("source: %s, tsc frequency: %" PRIu64 "\n",
+        (sys::CClock::source_tsc == sys::CClock::get_source())? "tsc": "monotonic", sys::CClock::get_tsc_frequency());
+
+    // 起点与CLOCK_MONOTONIC大致相同
+    if (absolute_difference(sys::CClock::get_nanoseconds(), monotonic_nanoseconds()) > 10000000)
+        return false;
+
+    uint64_t last = sys::CClock::get_nanoseconds();
+    for (int i=0; i<1000000; ++i)
+    {
+        const uint64_t now = sys::CClock::get_nanoseconds();
+        if (now < last)
+            return false;
+        last = now;
+    }
+
+    // 与CLOCK_MONOTONIC的间隔相差不超过0.5%
+    const uint64_t start = sys::CClock::get_nanoseconds();
+    const uint64_t monotonic_start = monotonic_nanoseconds();
+    const uint64_t start_cycles = sys::CUtils::rdtsc();
+    usleep(100000);
+    const uint64_t elapsed = sys::CClock::get_nanoseconds() - start;
+    const uint64_t monotonic_elapsed = monotonic_nanoseconds() - monotonic_start;
+    const uint64_t cycles_elapsed = sys::CClock::cycles_to_nanoseconds(sys::CUtils::rdtsc() - start_cycles);
+    printf("elapsed: %" PRIu64 "ns, monotonic: %" PRIu64 "ns, cycles: %" PRIu64 "ns\n", elapsed, monotonic_elapsed, cycles_elapsed);
+    if (absolute_difference(elapsed, monotonic_elapsed) > monotonic_elapsed/200)
+        return false;
+    if ((sys::CClock::source_tsc == sys::CClock::get_source()) && (absolute_difference(cycles_elapsed, monotonic_elapsed) > monotonic_elapsed/200))
+        return false;
+
+    // 粗粒度时钟
+    const uint64_t coarse = sys::CClock::get_coarse_nanoseconds();
+    return absolute_difference(coarse, monotonic_nanoseconds()) < 100000000;
+}
+
+static bool test_stop_watch()
+{
+    sys::CStopWatch stop_watch;
+    usleep(20000);
+    const uint64_t elapsed = stop_watch.get_elapsed_nanoseconds();
+    usleep(10000);
+    const uint64_t elapsed_microseconds = stop_watch.get_elapsed_microseconds(false);
+    const uint64_t total = stop_watch.get_total_elapsed_nanoseconds();
+    printf("stop watch: %" PRIu64 "ns, %" PRIu64 "us, total %" PRIu64 "ns\n", elapsed, elapsed_microseconds, total);
+    return (elapsed >= 20000000) && (elapsed < 200000000)
+        && (elapsed_microseconds >= 10000) && (total >= elapsed + elapsed_microseconds*1000)
+        && (stop_watch.get_start_seconds() <= time(NULL));
+}
+
+static bool test_time_thread()
+{
+    sys::CTimeThread time_thread;
+    const int64_t start = time_thread.get_monotonic_milliseconds();
+    if (!time_thread.start(10))
+        return false;
+
+    usleep(105000);
+    const int64_t elapsed = time_thread.get_monotonic_milliseconds() - start;
+    time_thread.stop();
+    time_thread.wait();
+    printf("time thread: %" PRId64 "ms, %" PRId64 "\n", elapsed, time_thread.get_milliseconds());
+    return (elapsed >= 80) && (elapsed <= 200)
+        && (absolute_difference(time_thread.get_seconds(), time(NULL)) <= 1)
+        && (absolute_difference(time_thread.get_milliseconds()/1000, time(NULL)) <= 1);
+}
+
+static void bench()
+{
+    const int number = 1000000;
+    uint64_t sum = 0;
+    uint64_t begin = monotonic_nanoseconds();
+    for (int i=0; i<number; ++i)
+        sum += sys::CClock::get_nanoseconds();
+    uint64_t clock_end = monotonic_nanoseconds();
+    for (int i=0; i<number; ++i)
+        sum += monotonic_nanoseconds();
+    uint64_t monotonic_end = monotonic_nanoseconds();
+    for (int i=0; i<number; ++i)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        sum += tv.tv_usec;
+    }
+    uint64_t end = monotonic_nanoseconds();
+    printf("CClock: %" PRIu64 "ns, clock_gettime: %" PRIu64 "ns, gettimeofday: %" PRIu64 "ns (%" PRIu64 ")\n",
+        (clock_end-begin)/number, (monotonic_end-clock_end)/number, (end-monotonic_end)/number, sum%10);
+}
+
+int main()
+{
+    if (!test_clock())
+        return 1;
+    if (!test_stop_watch())
+        return 1;
+    if (!test_time_thread())
+        return 1;
+    bench();
+
+    // 退回到CLOCK_MONOTONIC
+    sys::CClock::disable_tsc();
+    if ((sys::CClock::get_source() != sys::CClock::source_monotonic) || !test_clock() || !test_stop_watch())
+        return 1;
+
+    printf("clock ok\n");
+    return 0;
+}
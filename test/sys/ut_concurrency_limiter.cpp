@@ -0,0 +1,185 @@
+#include <mooon/sys/concurrency_limiter.h>
+#include <mooon/sys/utils.h>
+#include <pthread.h>
+#include <stdio.h>
+using namespace mooon;
+
+#define THREAD_NUMBER 8
+
+// 用模拟的耗时驱动算法：并发不超过capacity时耗时为base，超过后按排队线性增长
+static uint64_t simulate_rtt(uint32_t concurrency, uint32_t capacity, uint64_t base)
+{
+    return (concurrency <= capacity)? base: base * concurrency / capacity;
+}
+
+// 限制用满时，各算法收敛到下游容量附近，而不是一直增长到上限
+static bool test_converge(const char* name, sys::ILimitAlgorithm* algorithm, uint32_t capacity)
+{
+    uint32_t limit = algorithm->get_initial_limit();
+    uint32_t max_limit = 0;
+    for (int i=0; i<5000; ++i)
+    {
+        limit = algorithm->update(limit, limit, simulate_rtt(limit, capacity, 1000000), false);
+        if (i >= 4000)
+            max_limit = std::max(max_limit, limit);
+    }
+
+    printf("%s: limit=%u, max=%u, capacity=%u\n", name, limit, max_limit, capacity);
+    delete algorithm;
+    return (limit >= capacity/2) && (max_limit <= capacity*3);
+}
+
+// 过载信号使限制收缩，恢复后重新增长
+static bool test_dropped(const char* name, sys::ILimitAlgorithm* algorithm)
+{
+    uint32_t limit = algorithm->get_initial_limit();
+    for (int i=0; i<20; ++i)
+        limit = algorithm->update(limit, limit, 1000000, true);
+    const uint32_t shrunk = limit;
+    for (int i=0; i<500; ++i)
+        limit = algorithm->update(limit, limit, 1000000, false);
+
+    printf("%s: initial=%u, shrunk=%u, recovered=%u\n", name, algorithm->get_initial_limit(), shrunk, limit);
+    const bool ok = (shrunk < algorithm->get_initial_limit()) && (limit > shrunk);
+    delete algorithm;
+    return ok;
+}
+
+// 下游本身变慢（耗时与并发无关）后，梯度算法收缩一段时间后以新的耗时为基准重新增长
+static bool test_slowdown()
+{
+    sys::CGradientLimit gradient(50, 1, 1000, 0.2, 100);
+    uint32_t limit = 50;
+    for (int i=0; i<200; ++i)
+        limit = gradient.update(limit, limit, 1000000, false);
+    uint32_t min_limit = limit;
+    for (int i=0; i<1000; ++i)
+    {
+        limit = gradient.update(limit, limit, 3000000, false);
+        min_limit = std::min(min_limit, limit);
+    }
+
+    printf("slowdown: min=%u, limit=%u\n", min_limit, limit);
+    return (min_limit < 20) && (limit > 100);
+}
+
+// 限制没有被用到时不增长
+static bool test_app_limited()
+{
+    sys::CAimdLimit aimd(20);
+    sys::CGradientLimit gradient(20);
+    uint32_t aimd_limit = 20;
+    uint32_t gradient_limit = 20;
+    for (int i=0; i<100; ++i)
+    {
+        aimd_limit = aimd.update(aimd_limit, 2, 1000000, false);
+        gradient_limit = gradient.update(gradient_limit, 2, 1000000, false);
+    }
+    return (20 == aimd_limit) && (20 == gradient_limit);
+}
+
+// 达到限制时立即拒绝，释放后又可以获取
+static bool test_reject()
+{
+    sys::CConcurrencyLimiter limiter(new sys::CAimdLimit(2, 1, 2), "ut");
+    sys::CLimitTicket first, second, third;
+    if (!limiter.try_acquire(&first) || !limiter.try_acquire(&second) || limiter.try_acquire(&third))
+        return false;
+    if ((2 != limiter.get_in_flight()) || (1 != limiter.get_rejected_number()))
+        return false;
+
+    limiter.release(first, sys::limit_ignored);
+    if (!limiter.try_acquire(&third))
+        return false;
+    limiter.release(second, sys::limit_success);
+    limiter.release(third, sys::limit_dropped);
+    if ((0 != limiter.get_in_flight()) || (1 != limiter.get_limit()))
+        return false;
+
+    {
+        sys::CLimitGuard guard(&limiter);
+        sys::CLimitGuard rejected(&limiter);
+        if (!guard.is_acquired() || rejected.is_acquired())
+            return false;
+        guard.set_outcome(sys::limit_success);
+    }
+    sys::CLimitGuard unlimited(NULL);
+    return unlimited.is_acquired() && (0 == limiter.get_in_flight())
+        && (sys::CMetricsRegistry::get_singleton()->get_counter("concurrency_limiter.ut.rejected")->get() == 2);
+}
+
+static sys::CConcurrencyLimiter* sg_limiter = NULL;
+static volatile uint32_t sg_max_in_flight = 0;
+
+// 并发地获取和释放，在途数不超过限制的上限
+static void* call_proc(void*)
+{
+    for (int i=0; i<2000; ++i)
+    {
+        sys::CLimitGuard guard(sg_limiter);
+        if (!guard.is_acquired())
+            continue;
+
+        const uint32_t in_flight = sg_limiter->get_in_flight();
+        uint32_t current = sg_max_in_flight;
+        while ((in_flight > current) && !__atomic_compare_exchange_n(&sg_max_in_flight, &current, in_flight, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        sys::CUtils::microsleep(10);
+        guard.set_outcome((i % 100 == 0)? sys::limit_dropped: sys::limit_success);
+    }
+    return NULL;
+}
+
+static bool test_concurrent()
+{
+    sys::CConcurrencyLimiter limiter(new sys::CAimdLimit(2, 1, 4));
+    pthread_t threads[THREAD_NUMBER];
+    sg_limiter = &limiter;
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_create(&threads[i], NULL, call_proc, NULL);
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_join(threads[i], NULL);
+
+    printf("concurrent: max_in_flight=%u, rejected=%lu, limit=%u\n", sg_max_in_flight, (unsigned long)limiter.get_rejected_number(), limiter.get_limit());
+    return (sg_max_in_flight <= 4) && (0 == limiter.get_in_flight()) && (limiter.get_rejected_number() > 0);
+}
+
+int main()
+{
+    if (!test_converge("aimd", new sys::CAimdLimit(10, 1, 1000, 2), 50)
+     || !test_converge("vegas", new sys::CVegasLimit(10, 1, 1000), 50)
+     || !test_converge("gradient", new sys::CGradientLimit(10, 1, 1000), 50))
+    {
+        printf("converge failed\n");
+        return 1;
+    }
+    if (!test_dropped("aimd", new sys::CAimdLimit(100))
+     || !test_dropped("vegas", new sys::CVegasLimit(100))
+     || !test_dropped("gradient", new sys::CGradientLimit(100)))
+    {
+        printf("dropped failed\n");
+        return 1;
+    }
+    if (!test_slowdown())
+    {
+        printf("slowdown failed\n");
+        return 1;
+    }
+    if (!test_app_limited())
+    {
+        printf("app limited failed\n");
+        return 1;
+    }
+    if (!test_reject())
+    {
+        printf("reject failed\n");
+        return 1;
+    }
+    if (!test_concurrent())
+    {
+        printf("concurrent failed\n");
+        return 1;
+    }
+
+    printf("concurrency limiter ok\n");
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include "mooon/sys/clock.h"
+#include "mooon/sys/config_snapshot.h"
+#include "mooon/utils/string_utils.h"
+#include "mooon/utils/tokener.h"
+#include <inttypes.h>
+#include <map>
+#include <stdio.h>
+#include <unistd.h>
+using namespace mooon;
+
+// 以path和name为键的内存配置，值为字符串，多值以逗号分隔
+class CMapConfigReader: public sys::IConfigReader
+{
+public:
+    void set(const std::string& path, const std::string& name, const std::string& value)
+    {
+        _values[path + "|" + name] = value;
+    }
+
+    void erase(const std::string& path, const std::string& name)
+    {
+        _values.erase(path + "|" + name);
+    }
+
+private:
+    const std::string* find(const std::string& path, const std::string& name) const
+    {
+        std::map<std::string, std::string>::const_iterator iter = _values.find(path + "|" + name);
+        return (iter == _values.end())? NULL: &iter->second;
+    }
+
+    template <typename IntType>
+    bool get_int(const std::string& path, const std::string& name, IntType& value)
+    {
+        const std::string* str = find(path, name);
+        return (str != NULL) && utils::CStringUtils::string2int(str->c_str(), value);
+    }
+
+    virtual bool path_exist(const std::string& path) { return false; }
+    virtual bool name_exist(const std::string& path, const std::string& name) { return find(path, name) != NULL; }
+    virtual bool get_bool_value(const std::string& path, const std::string& name, bool& value)
+    {
+        const std::string* str = find(path, name);
+        if (NULL == str)
+            return false;
+        value = ("true" == *str);
+        return true;
+    }
+    virtual bool get_string_value(const std::string& path, const std::string& name, std::string& value)
+    {
+        const std::string* str = find(path, name);
+        if (NULL == str)
+            return false;
+        value = *str;
+        return true;
+    }
+    virtual bool get_int16_value(const std::string& path, const std::string& name, int16_t& value) { return get_int(path, name, value); }
+    virtual bool get_int32_value(const std::string& path, const std::string& name, int32_t& value) { return get_int(path, name, value); }
+    virtual bool get_int64_value(const std::string& path, const std::string& name, int64_t& value) { return get_int(path, name, value); }
+    virtual bool get_uint16_value(const std::string& path, const std::string& name, uint16_t& value) { return get_int(path, name, value); }
+    virtual bool get_uint32_value(const std::string& path, const std::string& name, uint32_t& value) { return get_int(path, name, value); }
+    virtual bool get_uint64_value(const std::string& path, const std::string& name, uint64_t& value) { return get_int(path, name, value); }
+    virtual bool get_text(const std::string& path, std::string& text) { return false; }
+    virtual bool get_string_values(const std::string& path, const std::string& name, std::vector<std::string>& values)
+    {
+        const std::string* str = find(path, name);
+        if (NULL == str)
+            return false;
+        values.clear();
+        utils::CTokener::split(&values, *str, ",");
+        return true;
+    }
+    virtual bool get_int16_values(const std::string& path, const std::string& name, std::vector<int16_t>& values) { return false; }
+    virtual bool get_int32_values(const std::string& path, const std::string& name, std::vector<int32_t>& values) { return false; }
+    virtual bool get_int64_values(const std::string& path, const std::string& name, std::vector<int64_t>& values) { return false; }
+    virtual bool get_uint16_values(const std::string& path, const std::string& name, std::vector<uint16_t>& values) { return false; }
+    virtual bool get_uint32_values(const std::string& path, const std::string& name, std::vector<uint32_t>& values) { return false; }
+    virtual bool get_uint64_values(const std::string& path, const std::string& name, std::vector<uint64_t>& values) { return false; }
+    virtual bool get_sub_config(const std::string& path, std::vector<IConfigReader*>& sub_config_array) { return false; }
+
+private:
+    std::map<std::string, std::string> _values;
+};
+
+// 每行为“path name value”的配置文件
+class CLineConfigFile: public sys::IConfigFile
+{
+private:
+    virtual bool open(const std::string& filepath)
+    {
+        FILE* fp = fopen(filepath.c_str(), "r");
+        if (NULL == fp)
+            return false;
+
+        char path[256], name[256], value[256];
+        _reader = CMapConfigReader();
+        while (3 == fscanf(fp, "%255s %255s %255s", path, name, value))
+            _reader.set(path, name, value);
+        fclose(fp);
+        return true;
+    }
+
+    virtual void close() {}
+    virtual sys::IConfigReader* get_config_reader() { return &_reader; }
+    virtual void free_config_reader(sys::IConfigReader* config_reader) {}
+    virtual int get_error_row() const { return 0; }
+    virtual int get_error_col() const { return 0; }
+    virtual std::string get_error_message() const { return "open failed"; }
+
+private:
+    CMapConfigReader _reader;
+};
+
+class CObserver: public sys::IConfigObserver
+{
+public:
+    CObserver(): notify_number(0) {}
+
+    virtual void on_config_changed(const sys::CConfigSnapshot* old_snapshot, const sys::CConfigSnapshot* new_snapshot, const std::vector<uint32_t>& changed_indexes)
+    {
+        ++notify_number;
+        last_changed_indexes = changed_indexes;
+        old_version = old_snapshot->get_version();
+        new_version = new_snapshot->get_version();
+    }
+
+public:
+    int notify_number;
+    std::vector<uint32_t> last_changed_indexes;
+    uint64_t old_version;
+    uint64_t new_version;
+};
+
+static bool test_reload()
+{
+    sys::CConfigCache config_cache;
+    const sys::config_handle_t<int32_t> age = config_cache.add_int32("/A/B/C", "age", 18);
+    const sys::config_handle_t<bool> enabled = config_cache.add_bool("/A", "enabled", false);
+    const sys::config_handle_t<uint64_t> size = config_cache.add_uint64("/A", "size", 100);
+    const sys::config_handle_t<std::string> name = config_cache.add_string("/A", "name", "none");
+    const sys::config_handle_t<std::vector<std::string> > hosts = config_cache.add_string_values("/A", "hosts");
+
+    // 未reload时为默认值
+    sys::CConfigCursor cursor(&config_cache);
+    if ((18 != cursor->get(age)) || cursor->get(enabled) || (100 != cursor->get(size)) || ("none" != cursor->get(name)) || cursor->is_found(age))
+        return false;
+
+    CObserver observer;
+    CMapConfigReader reader;
+    config_cache.add_observer(&observer);
+    reader.set("/A/B/C", "age", "32");
+    reader.set("/A", "enabled", "true");
+    reader.set("/A", "size", "x"); // 不合法，取默认值
+    reader.set("/A", "hosts", "h1,h2,h3");
+    if (3 != config_cache.reload(&reader))
+        return false;
+
+    const std::shared_ptr<const sys::CConfigSnapshot> first = config_cache.get_snapshot();
+    printf("reload: version=%" PRIu64", age=%d, hosts=%zu, changed=%zu\n",
+           cursor->get_version(), cursor->get(age), cursor->get(hosts).size(), observer.last_changed_indexes.size());
+    if ((32 != cursor->get(age)) || !cursor->get(enabled) || (100 != cursor->get(size)) || cursor->is_found(size)
+     || (3 != cursor->get(hosts).size()) || ("h2" != cursor->get(hosts)[1]) || !cursor->is_found(age))
+        return false;
+    if ((1 != observer.notify_number) || (observer.new_version != observer.old_version+1)
+     || (age.index != observer.last_changed_indexes[0]) || (hosts.index != observer.last_changed_indexes[2]))
+        return false;
+
+    // 没有变化时不发布新快照
+    const uint64_t version = config_cache.get_version();
+    if ((0 != config_cache.reload(&reader)) || (version != config_cache.get_version()) || (1 != observer.notify_number))
+        return false;
+
+    // 配置项被删除，回到默认值，旧快照仍然可用
+    reader.erase("/A/B/C", "age");
+    if ((1 != config_cache.reload(&reader)) || (18 != cursor->get(age)) || (32 != first->get(age)))
+        return false;
+    config_cache.remove_observer(&observer);
+    return (2 == observer.notify_number) && (3 == config_cache.get_reload_number());
+}
+
+static bool write_config(const char* filepath, const char* content)
+{
+    FILE* fp = fopen(filepath, "w");
+    if (NULL == fp)
+        return false;
+    fputs(content, fp);
+    fclose(fp);
+    return true;
+}
+
+static bool wait_version(const sys::CConfigCache& config_cache, uint64_t version)
+{
+    for (int i=0; i<200; ++i)
+    {
+        if (config_cache.get_version() >= version)
+            return true;
+        usleep(10000);
+    }
+    return false;
+}
+
+// 直接改写和以rename方式替换都能触发reload
+static bool test_watch_file()
+{
+    const char* filepath = "/tmp/ut_config_snapshot.conf";
+    const char* tmp_filepath = "/tmp/ut_config_snapshot.conf.tmp";
+    CLineConfigFile config_file;
+    sys::CConfigCache config_cache;
+    std::string error_message;
+    const sys::config_handle_t<int64_t> timeout = config_cache.add_int64("/server", "timeout", 0);
+
+    if (!write_config(filepath, "/server timeout 10\n")
+     || (1 != config_cache.reload_file(&config_file, filepath, &error_message)))
+        return false;
+    if (-1 != config_cache.reload_file(&config_file, "/nonexistent/ut_config_snapshot.conf", &error_message))
+        return false;
+    printf("expected: %s\n", error_message.c_str());
+
+    config_cache.watch_file(&config_file, filepath);
+    sys::CConfigCursor cursor(&config_cache);
+    uint64_t version = config_cache.get_version();
+    if (!write_config(filepath, "/server timeout 20\n") || !wait_version(config_cache, version+1) || (20 != cursor->get(timeout)))
+        return false;
+
+    version = config_cache.get_version();
+    if (!write_config(tmp_filepath, "/server timeout 30\n") || (rename(tmp_filepath, filepath) != 0)
+     || !wait_version(config_cache, version+1) || (30 != cursor->get(timeout)))
+        return false;
+
+    config_cache.stop_watching();
+    unlink(filepath);
+    printf("watch: version=%" PRIu64", timeout=%" PRId64", failures=%" PRIu64"\n",
+           config_cache.get_version(), cursor->get(timeout), config_cache.get_reload_failure_number());
+    return 1 == config_cache.get_reload_failure_number();
+}
+
+// 热路径上一次读取的开销
+static bool test_cost()
+{
+    sys::CConfigCache config_cache;
+    const sys::config_handle_t<int32_t> age = config_cache.add_int32("/A/B/C", "age", 1);
+    sys::CConfigCursor cursor(&config_cache);
+    const int number = 10000000;
+    int64_t sum = 0;
+    const uint64_t start = sys::CClock::get_nanoseconds();
+    for (int i=0; i<number; ++i)
+        sum += cursor->get(age);
+    printf("cursor get: %.2fns\n", (sys::CClock::get_nanoseconds() - start) / static_cast<double>(number));
+    return number == sum;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_reload())
+            return 1;
+        if (!test_watch_file())
+            return 1;
+        if (!test_cost())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("config snapshot ok\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <mooon/sys/curl_multi.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace mooon;
+
+static volatile int sg_accept_number = 0;
+
+// 以keep-alive方式应答一个连接上的所有请求，响应体为请求的路径，POST时为请求体
+static void* serve_connection(void* param)
+{
+    const int fd = static_cast<int>(reinterpret_cast<intptr_t>(param));
+    std::string buffer;
+    char data[4096];
+
+    for (;;)
+    {
+        std::string::size_type pos;
+        while ((pos = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            const ssize_t bytes = read(fd, data, sizeof(data));
+            if (bytes <= 0)
+            {
+                close(fd);
+                return NULL;
+            }
+            buffer.append(data, bytes);
+        }
+
+        const std::string head = buffer.substr(0, pos);
+        buffer.erase(0, pos+4);
+        std::string body = head.substr(head.find(' ')+1);
+        body = body.substr(0, body.find(' '));
+
+        const std::string::size_type content_length_pos = head.find("Content-Length: ");
+        if (content_length_pos != std::string::npos)
+        {
+            const size_t content_length = atoi(head.c_str()+content_length_pos+16);
+            while (buffer.size() < content_length)
+            {
+                const ssize_t bytes = read(fd, data, sizeof(data));
+                if (bytes <= 0)
+                {
+                    close(fd);
+                    return NULL;
+                }
+                buffer.append(data, bytes);
+            }
+            body = buffer.substr(0, content_length);
+            buffer.erase(0, content_length);
+        }
+
+        const std::string response = utils::CStringUtils::format_string(
+                "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%s", body.size(), body.c_str());
+        if (write(fd, response.data(), response.size()) != static_cast<ssize_t>(response.size()))
+            break;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static void* serve(void* param)
+{
+    const int listen_fd = static_cast<int>(reinterpret_cast<intptr_t>(param));
+    for (;;)
+    {
+        const int fd = accept(listen_fd, NULL, NULL);
+        if (-1 == fd)
+            break;
+
+        __atomic_add_fetch(&sg_accept_number, 1, __ATOMIC_SEQ_CST);
+        pthread_t thread;
+        pthread_create(&thread, NULL, serve_connection, reinterpret_cast<void*>(static_cast<intptr_t>(fd)));
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+class CTestTransfer: public sys::CCurlTransfer
+{
+public:
+    CTestTransfer(const std::string& url, const std::string& expected, int* finished_number, int* ok_number)
+        : sys::CCurlTransfer(url), _expected(expected), _finished_number(finished_number), _ok_number(ok_number)
+    {
+    }
+
+private:
+    virtual bool on_response_body(const char* data, size_t size)
+    {
+        _body.append(data, size);
+        return true;
+    }
+
+    virtual void on_finished(int errcode, const std::string& errmsg)
+    {
+        ++*_finished_number;
+        if ((0 == errcode) && (200 == get_response_code()) && (_body == _expected))
+            ++*_ok_number;
+        else
+            printf("%s: %d %s [%s]\n", get_url().c_str(), errcode, errmsg.c_str(), _body.c_str());
+        delete this;
+    }
+
+private:
+    const std::string _expected;
+    std::string _body;
+    int* _finished_number;
+    int* _ok_number;
+};
+
+int main()
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 100))
+     || (-1 == getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len)))
+        return 1;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve, reinterpret_cast<void*>(static_cast<intptr_t>(listen_fd)));
+
+    try
+    {
+        // 100个传输并发，到同一主机最多4个连接，连接被复用
+        const std::string prefix = utils::CStringUtils::format_string("http://127.0.0.1:%d", ntohs(addr.sin_port));
+        int finished_number = 0;
+        int ok_number = 0;
+        sys::CCurlShare curl_share;
+        sys::CCurlMulti curl_multi(&curl_share, 4);
+        curl_multi.create();
+        for (int i=0; i<100; ++i)
+        {
+            const std::string path = utils::CStringUtils::format_string("/hook/%d", i);
+            curl_multi.add(new CTestTransfer(prefix+path, path, &finished_number, &ok_number));
+        }
+
+        CTestTransfer* post = new CTestTransfer(prefix+"/post", "{\"event\":1}", &finished_number, &ok_number);
+        post->set_post_data("{\"event\":1}");
+        curl_multi.add(post);
+        for (int i=0; (i<100) && (curl_multi.run(100) > 0); ++i);
+
+        printf("finished: %d, ok: %d, connections: %d\n", finished_number, ok_number, sg_accept_number);
+        if ((finished_number != 101) || (ok_number != 101) || (sg_accept_number > 4))
+            return 1;
+    }
+    catch (utils::CException& ex)
+    {
+        fprintf(stderr, "main exception: %s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("curl multi ok\n");
+    return 0;
+}
@@ -17,10 +17,171 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include "mooon/sys/datetime_utils.h"
+#include <stdlib.h>
 SYS_NAMESPACE_USE
 
+static bool same_tm(const struct tm& a, const struct tm& b)
+{
+    return (a.tm_year == b.tm_year) && (a.tm_mon == b.tm_mon) && (a.tm_mday == b.tm_mday)
+        && (a.tm_hour == b.tm_hour) && (a.tm_min == b.tm_min) && (a.tm_sec == b.tm_sec)
+        && (a.tm_wday == b.tm_wday) && (a.tm_yday == b.tm_yday) && (a.tm_isdst == b.tm_isdst)
+        && (a.tm_gmtoff == b.tm_gmtoff);
+}
+
+static bool test_civil()
+{
+    for (int64_t days=-800000; days<=800000; ++days)
+    {
+        int year, month, day;
+        CDatetimeUtils::civil_from_days(days, &year, &month, &day);
+        if (CDatetimeUtils::days_from_civil(year, month, day) != days)
+        {
+            printf("civil mismatch: %" PRId64 "\n", days);
+            return false;
+        }
+    }
+
+    // 与timegm对比
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 2016 - 1900;
+    tm.tm_mon = 1;
+    tm.tm_mday = 29;
+    return (CDatetimeUtils::days_from_civil(2016, 2, 29) * 86400 == timegm(&tm))
+        && (0 == CDatetimeUtils::days_from_civil(1970, 1, 1))
+        && (CDatetimeUtils::days_from_civil(2017, 2, 31) == CDatetimeUtils::days_from_civil(2017, 3, 3));
+}
+
+// 与localtime_r和mktime逐一对比
+static bool test_timezone(const char* timezone)
+{
+    setenv("TZ", timezone, 1);
+    CDatetimeUtils::reload_timezone();
+
+    // 粗粒度覆盖探测范围内外，2021年内每隔约半小时，覆盖夏令时切换前后
+    for (int64_t t=-100000000LL; t<5000000000LL; t+=((t>=1609459200LL) && (t<1640995200LL))? 1801: 7*86413)
+    {
+        const time_t t_ = static_cast<time_t>(t);
+        struct tm expected;
+        struct tm result;
+        localtime_r(&t_, &expected);
+        CDatetimeUtils::time2tm(t_, &result);
+        if (!same_tm(result, expected))
+        {
+            printf("%s time2tm mismatch: %" PRId64 "\n", timezone, t);
+            return false;
+        }
+
+        // 没有夏令时的区间中isdst为1时，mktime要向前后探测数百次，只抽查一部分
+        for (int isdst=-1; isdst<=((0 == t%16)? 1: 0); ++isdst)
+        {
+            struct tm tm = expected;
+            tm.tm_isdst = isdst;
+            tm.tm_min += 17; // 也覆盖切换的间隙中
+            const time_t converted = CDatetimeUtils::tm2time_t(tm);
+            if (converted != mktime(&tm))
+            {
+                printf("%s tm2time_t mismatch: %" PRId64 ", isdst=%d\n", timezone, t, isdst);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool test_format()
+{
+    const time_t t = 1500000000; // 2017-07-14 02:40:00 UTC
+    struct tm tm;
+    if ((CDatetimeUtils::to_string(t) != "2017-07-14 02:40:00")
+     || (CDatetimeUtils::to_datetime(t, "%04d%02d%02d%02d%02d%02d") != "20170714024000")
+     || (CDatetimeUtils::to_date(t) != "2017-07-14")
+     || (CDatetimeUtils::to_time(t) != "02:40:00")
+     || (CDatetimeUtils::time2date(t) != 20170714))
+        return false;
+
+    // 固定宽度以外的格式仍交给strptime
+    if (!CDatetimeUtils::datetime_struct_from_string("2017-7-4 2:40:00", &tm)
+     || (tm.tm_mon != 6) || (tm.tm_mday != 4) || (tm.tm_hour != 2)
+     || CDatetimeUtils::datetime_struct_from_string("2017-13-04 02:40:00", &tm)
+     || CDatetimeUtils::datetime_struct_from_string("2017-07-04 02:40", &tm))
+        return false;
+    if (!CDatetimeUtils::datetime_struct_from_string("2016-02-29 23:59:59", &tm)
+     || (tm.tm_wday != 1) || (tm.tm_yday != 59))
+        return false;
+
+    if ((CDatetimeUtils::neighbor_date_bydate("2016-02-28", 1) != "2016-02-29")
+     || (CDatetimeUtils::neighbor_date_bydate("2017-03-01", -1) != "2017-02-28")
+     || (CDatetimeUtils::neighbor_date_bydate("2016-12-31", 366) != "2018-01-01")
+     || (CDatetimeUtils::neighbor_date_bytime("2016-12-31 12:00:00", -365) != "2016-01-01")
+     || (CDatetimeUtils::neighbor_month_bydate("2016-12-31", 2) != "2017-02-01"))
+        return false;
+
+    char cached[sizeof("YYYY-MM-DD hh:mm:ss/0123456789")];
+    const std::string current = CDatetimeUtils::get_current_datetime();
+    (void)get_cached_formatted_datetime(cached, sizeof(cached), false);
+    printf("current: %s, cached: %s\n", current.c_str(), cached);
+    return 0 == strncmp(cached, current.c_str(), sizeof("YYYY-MM-DD hh:mm")-1);
+}
+
+static void bench()
+{
+    const int number = 1000000;
+    uint64_t begin = CDatetimeUtils::get_current_microseconds();
+    size_t size = 0;
+    for (int i=0; i<number; ++i)
+        size += CDatetimeUtils::to_string(static_cast<time_t>(1500000000 + i*61)).size();
+    uint64_t middle = CDatetimeUtils::get_current_microseconds();
+    for (int i=0; i<number; ++i)
+    {
+        const time_t t = static_cast<time_t>(1500000000 + i*61);
+        struct tm tm;
+        char buffer[sizeof("YYYY-MM-DD hh:mm:ss")];
+        localtime_r(&t, &tm);
+        size += snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d",
+            tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    }
+    uint64_t end = CDatetimeUtils::get_current_microseconds();
+    printf("to_string: %" PRIu64 "us, localtime_r+snprintf: %" PRIu64 "us (%zu)\n", middle-begin, end-middle, size);
+
+    time_t sum = 0;
+    struct tm tm;
+    CDatetimeUtils::time2tm(1500000000, &tm);
+    begin = CDatetimeUtils::get_current_microseconds();
+    for (int i=0; i<number; ++i)
+    {
+        tm.tm_sec = i % 60;
+        sum += CDatetimeUtils::tm2time_t(tm);
+    }
+    middle = CDatetimeUtils::get_current_microseconds();
+    for (int i=0; i<number; ++i)
+    {
+        tm.tm_sec = i % 60;
+        sum += mktime(&tm);
+    }
+    end = CDatetimeUtils::get_current_microseconds();
+    printf("tm2time_t: %" PRIu64 "us, mktime: %" PRIu64 "us (%ld)\n", middle-begin, end-middle, static_cast<long>(sum));
+}
+
 int main()
 {
+    if (!test_civil())
+        return 1;
+
+    static const char* timezones[] = { "UTC", "Asia/Shanghai", "America/New_York", "Europe/London", "Australia/Lord_Howe", "Asia/Kolkata" };
+    for (size_t i=0; i<sizeof(timezones)/sizeof(timezones[0]); ++i)
+    {
+        if (!test_timezone(timezones[i]))
+            return 1;
+    }
+
+    setenv("TZ", "UTC", 1);
+    CDatetimeUtils::reload_timezone();
+    if (!test_format())
+        return 1;
+    bench();
+
     struct tm datetime_struct;
     const char* str = "2010-09-18 17:28:30";
 
@@ -66,5 +227,6 @@ int main()
               ,result.tm_sec);
     }
 
+    printf("datetime utils ok\n");
     return 0;
 }
@@ -0,0 +1,147 @@
+#include <mooon/sys/db_batch_inserter.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// 不连接DB的假连接，记录执行的INSERT语句
+class CFakeConnection: public mooon::sys::CDBConnectionBase
+{
+public:
+    CFakeConnection()
+        : mooon::sys::CDBConnectionBase(1024), _failure(false)
+    {
+    }
+
+    virtual void open() { _is_established = true; }
+    virtual void close() throw () { _is_established = false; }
+    virtual void reopen() {}
+
+    virtual std::string escape_string(const std::string& str) const
+    {
+        std::string result;
+        for (std::string::size_type i=0; i<str.size(); ++i)
+        {
+            if ('\'' == str[i])
+                result.push_back('\\');
+            result.push_back(str[i]);
+        }
+        return result;
+    }
+
+    virtual uint64_t update(const char* format, ...)
+    {
+        va_list ap;
+        va_start(ap, format);
+        const char* sql = va_arg(ap, const char*);
+        va_end(ap);
+
+        mooon::sys::CUtils::millisleep(10); // 模拟执行耗时
+        if (_failure)
+            THROW_DB_EXCEPTION(sql, "Duplicate entry", 1062);
+        _sqls.push_back(sql);
+        return 1;
+    }
+
+    virtual std::string str() throw () { return "fake"; }
+    void set_failure(bool failure) { _failure = failure; }
+    const std::vector<std::string>& get_sqls() const { return _sqls; }
+
+private:
+    virtual void do_query(mooon::sys::DBTable& db_table, const char* sql, int sql_length) {}
+
+private:
+    volatile bool _failure;
+    std::vector<std::string> _sqls;
+};
+
+static mooon::sys::DBRow make_row(int id, const std::string& name)
+{
+    mooon::sys::DBRow row;
+    row.push_back(mooon::utils::CStringUtils::int_tostring(id));
+    row.push_back(name);
+    return row;
+}
+
+// 达到行数或字节数时自动flush
+static bool test_sync()
+{
+    CFakeConnection db_connection;
+    mooon::sys::CDBBatchInserter inserter(&db_connection, "t", "id,name");
+    inserter.set_max_rows(3);
+    inserter.set_on_duplicate_update("name=VALUES(name)");
+    for (int i=0; i<7; ++i)
+        inserter.add_row(make_row(i, "a'b"));
+    if (db_connection.get_sqls().size() != 2)
+        return false;
+    inserter.flush();
+
+    const std::vector<std::string>& sqls = db_connection.get_sqls();
+    printf("%s\n", sqls[0].c_str());
+    if ((sqls.size() != 3)
+     || (sqls[0] != "INSERT INTO t (id,name) VALUES ('0','a\\'b'),('1','a\\'b'),('2','a\\'b') ON DUPLICATE KEY UPDATE name=VALUES(name)")
+     || (sqls[2] != "INSERT INTO t (id,name) VALUES ('6','a\\'b') ON DUPLICATE KEY UPDATE name=VALUES(name)")
+     || (inserter.get_batch_number() != 3) || (inserter.get_affected_rows() != 3))
+        return false;
+
+    // 每条语句不超过max_bytes
+    CFakeConnection db_connection2;
+    mooon::sys::CDBBatchInserter inserter2(&db_connection2, "t");
+    inserter2.set_max_bytes(100);
+    inserter2.set_ignore(true);
+    for (int i=0; i<20; ++i)
+        inserter2.add_row(make_row(i, "0123456789"));
+    inserter2.flush();
+    for (size_t i=0; i<db_connection2.get_sqls().size(); ++i)
+    {
+        if ((db_connection2.get_sqls()[i].size() > 100) || (0 != db_connection2.get_sqls()[i].find("INSERT IGNORE INTO t VALUES ")))
+            return false;
+    }
+    printf("max bytes: %zu batches\n", db_connection2.get_sqls().size());
+    return (db_connection2.get_sqls().size() > 1) && (20 == inserter2.get_row_number());
+}
+
+// 后台执行，出错时在之后的调用中抛出
+static bool test_async()
+{
+    CFakeConnection db_connection;
+    mooon::sys::CDBBatchInserter inserter(&db_connection, "t");
+    inserter.set_max_rows(10);
+    inserter.start_async(2);
+    for (int i=0; i<100; ++i)
+        inserter.add_row(make_row(i, "x"));
+    inserter.flush();
+    if ((db_connection.get_sqls().size() != 10) || (inserter.get_affected_rows() != 10))
+        return false;
+
+    db_connection.set_failure(true);
+    inserter.add_row(make_row(100, "x"));
+    try
+    {
+        inserter.flush();
+        return false;
+    }
+    catch (mooon::sys::CDBException& ex)
+    {
+        printf("async error: %s\n", ex.str().c_str());
+        if (ex.errcode() != 1062)
+            return false;
+    }
+
+    // 错误只抛出一次
+    db_connection.set_failure(false);
+    inserter.add_row(make_row(101, "x"));
+    inserter.flush();
+    return 11 == db_connection.get_sqls().size();
+}
+
+int main()
+{
+    if (!test_sync())
+        return 1;
+    if (!test_async())
+        return 1;
+
+    printf("db batch inserter ok\n");
+    return 0;
+}
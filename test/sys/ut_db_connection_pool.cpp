@@ -0,0 +1,212 @@
+#include <mooon/sys/db_connection_pool.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/utils.h>
+#include <stdio.h>
+
+// 不连接DB的假连接，记录各操作的次数
+class CFakeConnection: public mooon::sys::CDBConnectionBase
+{
+public:
+    static volatile bool sg_open_failure;
+    static volatile bool sg_ping_failure;
+    static volatile int sg_open_number;
+    static volatile int sg_ping_number;
+    static volatile int sg_close_number;
+
+public:
+    CFakeConnection()
+        : mooon::sys::CDBConnectionBase(1024)
+    {
+    }
+
+    virtual void open()
+    {
+        __atomic_add_fetch(&sg_open_number, 1, __ATOMIC_SEQ_CST);
+        if (sg_open_failure)
+            THROW_DB_EXCEPTION(NULL, "connect failed", 2003);
+        _is_established = true;
+    }
+
+    virtual void close() throw ()
+    {
+        __atomic_add_fetch(&sg_close_number, 1, __ATOMIC_SEQ_CST);
+        _is_established = false;
+    }
+
+    virtual void reopen()
+    {
+        close();
+        open();
+    }
+
+    virtual void ping()
+    {
+        __atomic_add_fetch(&sg_ping_number, 1, __ATOMIC_SEQ_CST);
+        if (sg_ping_failure)
+            THROW_DB_EXCEPTION(NULL, "server has gone away", 2006);
+    }
+
+    virtual uint64_t update(const char* format, ...) { return 0; }
+    virtual std::string str() throw () { return "fake"; }
+
+private:
+    virtual void do_query(mooon::sys::DBTable& db_table, const char* sql, int sql_length) {}
+};
+
+volatile bool CFakeConnection::sg_open_failure = false;
+volatile bool CFakeConnection::sg_ping_failure = false;
+volatile int CFakeConnection::sg_open_number = 0;
+volatile int CFakeConnection::sg_ping_number = 0;
+volatile int CFakeConnection::sg_close_number = 0;
+
+class CFakeConnectionPool: public mooon::sys::CDBConnectionPool
+{
+private:
+    virtual mooon::sys::DBConnection* create_connection()
+    {
+        return new CFakeConnection;
+    }
+};
+
+static void delayed_pay_back(mooon::sys::CDBConnectionPool* db_pool, mooon::sys::DBConnection* db_connection)
+{
+    mooon::sys::CUtils::millisleep(50);
+    db_pool->pay_back(db_connection);
+}
+
+// 达到上限后等待归还，超时返回NULL
+static bool test_bounded()
+{
+    CFakeConnectionPool db_pool;
+    db_pool.create(2, 60, 1);
+    if (CFakeConnection::sg_open_number != 1)
+        return false;
+
+    mooon::sys::DBConnection* first = db_pool.borrow(0);
+    mooon::sys::DBConnection* second = db_pool.borrow(0);
+    if ((NULL == first) || (NULL == second) || (db_pool.borrow(20) != NULL))
+        return false;
+
+    // 在等待中得到另一线程归还的连接
+    mooon::sys::CThreadEngine engine(mooon::sys::bind(&delayed_pay_back, static_cast<mooon::sys::CDBConnectionPool*>(&db_pool), first));
+    mooon::sys::DBConnection* third = db_pool.borrow(1000);
+    engine.join();
+    if (third != first)
+        return false;
+    db_pool.pay_back(second);
+    db_pool.pay_back(third);
+
+    mooon::sys::DBConnectionPoolStats stats;
+    db_pool.get_stats(&stats);
+    printf("bounded: connection=%u, idle=%u, borrow=%" PRIu64 ", timeout=%" PRIu64 ", max_wait=%" PRIu64 "us\n",
+            stats.connection_number, stats.idle_number, stats.borrow_number, stats.borrow_timeout_number, stats.max_wait_microseconds);
+    return (2 == stats.connection_number) && (2 == stats.idle_number) && (3 == stats.borrow_number)
+        && (1 == stats.borrow_timeout_number) && (2 == stats.open_number) && (stats.max_wait_microseconds >= 20000);
+}
+
+// 只有空闲超过阈值的连接才ping，ping失败的被重建
+static bool test_validation()
+{
+    CFakeConnectionPool db_pool;
+    db_pool.create(1, 60);
+    CFakeConnection::sg_ping_number = 0;
+
+    db_pool.pay_back(db_pool.borrow());
+    db_pool.pay_back(db_pool.borrow());
+    if (CFakeConnection::sg_ping_number != 0)
+        return false;
+
+    CFakeConnectionPool always_ping_pool;
+    always_ping_pool.create(1, 0);
+    always_ping_pool.pay_back(always_ping_pool.borrow());
+    always_ping_pool.pay_back(always_ping_pool.borrow());
+    if (CFakeConnection::sg_ping_number != 1)
+        return false;
+
+    const int open_number = CFakeConnection::sg_open_number;
+    CFakeConnection::sg_ping_failure = true;
+    mooon::sys::DBConnection* db_connection = always_ping_pool.borrow();
+    CFakeConnection::sg_ping_failure = false;
+    if ((NULL == db_connection) || !db_connection->is_established() || (CFakeConnection::sg_open_number != open_number+1))
+        return false;
+    always_ping_pool.pay_back(db_connection);
+
+    mooon::sys::DBConnectionPoolStats stats;
+    always_ping_pool.get_stats(&stats);
+    printf("validation: ping=%" PRIu64 ", ping_failure=%" PRIu64 "\n", stats.ping_number, stats.ping_failure_number);
+    return (2 == stats.ping_number) && (1 == stats.ping_failure_number) && (1 == stats.connection_number);
+}
+
+// 出错的连接被释放，建立失败时让出名额
+static bool test_broken()
+{
+    CFakeConnectionPool db_pool;
+    db_pool.create(1, 60);
+
+    const int close_number = CFakeConnection::sg_close_number;
+    db_pool.pay_back(db_pool.borrow(), true);
+    if (CFakeConnection::sg_close_number != close_number+1)
+        return false;
+
+    CFakeConnection::sg_open_failure = true;
+    try
+    {
+        (void)db_pool.borrow();
+        return false;
+    }
+    catch (mooon::sys::CDBException& db_error)
+    {
+        printf("open failure: %s\n", db_error.str().c_str());
+    }
+    CFakeConnection::sg_open_failure = false;
+
+    mooon::sys::DBConnectionPoolStats stats;
+    {
+        mooon::sys::CDBConnectionPoolHelper db_connection(&db_pool, 0);
+        if (NULL == db_connection.get())
+            return false;
+        db_pool.get_stats(&stats);
+    }
+
+    printf("broken: broken=%" PRIu64 ", open_failure=%" PRIu64 ", connection=%u\n", stats.broken_number, stats.open_failure_number, stats.connection_number);
+    return (1 == stats.broken_number) && (1 == stats.open_failure_number) && (1 == stats.connection_number) && (0 == stats.idle_number);
+}
+
+// 借出数达到并发限制时立即返回NULL，以broken归还时限制收缩
+static bool test_limiter()
+{
+    CFakeConnectionPool db_pool;
+    mooon::sys::CConcurrencyLimiter limiter(new mooon::sys::CAimdLimit(2, 1, 10));
+    db_pool.set_concurrency_limiter(&limiter);
+    db_pool.create(4, 60);
+
+    mooon::sys::DBConnection* first = db_pool.borrow(0);
+    mooon::sys::DBConnection* second = db_pool.borrow(0);
+    const uint64_t begin = mooon::sys::CClock::get_microseconds();
+    if ((NULL == first) || (NULL == second) || (db_pool.borrow(1000) != NULL))
+        return false;
+    const uint64_t rejected_microseconds = mooon::sys::CClock::get_microseconds() - begin;
+
+    // 限制被用满时成功归还加一，broken归还乘以0.9
+    db_pool.pay_back(second);
+    db_pool.pay_back(first, true);
+    mooon::sys::DBConnectionPoolStats stats;
+    db_pool.get_stats(&stats);
+    printf("limiter: limit=%u, rejected=%" PRIu64 ", %" PRIu64 "us\n", limiter.get_limit(), stats.limit_rejected_number, rejected_microseconds);
+    return (1 == stats.limit_rejected_number) && (rejected_microseconds < 100000) && (0 == limiter.get_in_flight()) && (2 == limiter.get_limit());
+}
+
+int main()
+{
+    if (!test_bounded())
+        return 1;
+    if (!test_validation())
+        return 1;
+    if (!test_broken())
+        return 1;
+    if (!test_limiter())
+        return 1;
+
+    printf("db connection pool ok\n");
+    return 0;
+}
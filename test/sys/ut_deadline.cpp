@@ -0,0 +1,75 @@
+#include <mooon/sys/clock.h>
+#include <mooon/sys/deadline.h>
+#include <stdio.h>
+#include <unistd.h>
+SYS_NAMESPACE_USE
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { printf("line %d: %s\n", __LINE__, #cond); return false; } \
+    } while (0)
+
+static bool test_deadline()
+{
+    CDeadline infinite;
+    CHECK(infinite.is_infinite() && !infinite.is_expired());
+    CHECK(-1 == infinite.get_remaining_milliseconds());
+    CHECK((0 == infinite.clamp_milliseconds(0)) && (500 == infinite.clamp_milliseconds(500)));
+
+    CDeadline deadline(100);
+    CHECK(!deadline.is_infinite() && !deadline.is_expired());
+    const int remaining = deadline.get_remaining_milliseconds();
+    CHECK((remaining > 50) && (remaining <= 100));
+    CHECK(10 == deadline.clamp_milliseconds(10));
+    CHECK(deadline.clamp_milliseconds(1000) <= 100);
+    CHECK(deadline.clamp_milliseconds(0) <= 100); // 原来不超时的也受截止时间的限制
+
+    CHECK(CDeadline::earlier(infinite, deadline).get_nanoseconds() == deadline.get_nanoseconds());
+    CHECK(CDeadline::earlier(deadline, CDeadline(1000)).get_nanoseconds() == deadline.get_nanoseconds());
+
+    // 过期后剩余0毫秒，但收紧的超时至少为1，不会变成不超时
+    CDeadline expired = CDeadline::from_nanoseconds(CClock::get_nanoseconds() - 1);
+    CHECK(expired.is_expired());
+    CHECK(0 == expired.get_remaining_milliseconds());
+    CHECK((1 == expired.clamp_milliseconds(0)) && (1 == expired.clamp_milliseconds(100)));
+
+    usleep(120000);
+    CHECK(deadline.is_expired());
+    return true;
+}
+
+static bool test_scope()
+{
+    CHECK(CDeadline::get_current().is_infinite());
+    {
+        CDeadline outer(1000);
+        CDeadlineScope scope(outer);
+        CHECK(CDeadline::get_current().get_nanoseconds() == outer.get_nanoseconds());
+        {
+            // 内层不会比外层晚
+            CDeadlineScope inner_scope(CDeadline(5000));
+            CHECK(CDeadline::get_current().get_nanoseconds() == outer.get_nanoseconds());
+        }
+        {
+            CDeadline inner(10);
+            CDeadlineScope inner_scope(inner);
+            CHECK(CDeadline::get_current().get_nanoseconds() == inner.get_nanoseconds());
+            {
+                CDeadlineScope infinite_scope((CDeadline()));
+                CHECK(CDeadline::get_current().get_nanoseconds() == inner.get_nanoseconds());
+            }
+        }
+        CHECK(CDeadline::get_current().get_nanoseconds() == outer.get_nanoseconds());
+    }
+    CHECK(CDeadline::get_current().is_infinite());
+    return true;
+}
+
+int main()
+{
+    if (!test_deadline() || !test_scope())
+        return 1;
+
+    printf("deadline ok\n");
+    return 0;
+}
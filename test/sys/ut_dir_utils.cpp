@@ -0,0 +1,158 @@
+#include "mooon/sys/dir_utils.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/utils.h"
+#include <fcntl.h>
+#include <set>
+#include <stdio.h>
+#include <unistd.h>
+using namespace mooon;
+
+static const char* sg_root = "/tmp/ut_dir_utils";
+
+// 3层，每层4个子目录，每个目录下10个文件，第i个文件i字节，另有一个符号链接
+static off_t make_tree(const std::string& dirpath, int depth)
+{
+    off_t size = 0;
+    sys::CDirUtils::create_directory(dirpath.c_str());
+    for (int i=0; i<10; ++i)
+    {
+        const std::string filepath = dirpath + "/file" + std::to_string(i);
+        int fd = open(filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        const std::string data(i, 'x');
+        if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+            return -1;
+        close(fd);
+        size += i;
+    }
+    if (-1 == symlink("file9", (dirpath + "/link").c_str()))
+        return -1;
+
+    if (depth > 0)
+    {
+        for (int i=0; i<4; ++i)
+        {
+            const off_t subdir_size = make_tree(dirpath + "/dir" + std::to_string(i), depth-1);
+            if (-1 == subdir_size)
+                return -1;
+            size += subdir_size;
+        }
+    }
+    return size;
+}
+
+class CCollectVisitor: public sys::IDirVisitor
+{
+public:
+    CCollectVisitor(bool skip_dir0)
+        : link_number(0), _skip_dir0(skip_dir0)
+    {
+    }
+
+    int link_number;
+    std::set<std::string> paths;
+
+private:
+    virtual bool enter_directory(const sys::dir_entry_t& entry)
+    {
+        return !_skip_dir0 || (strcmp(entry.name, "dir0") != 0);
+    }
+
+    virtual void on_entry(const sys::dir_entry_t& entry)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        paths.insert(*entry.dirpath + "/" + entry.name);
+        if (DT_LNK == entry.type)
+            ++link_number;
+    }
+
+private:
+    const bool _skip_dir0;
+    sys::CLock _lock;
+};
+
+// 以unlinkat相对于目录句柄删除文件
+class CUnlinkVisitor: public sys::IDirVisitor
+{
+private:
+    virtual void on_entry(const sys::dir_entry_t& entry)
+    {
+        (void)unlinkat(entry.dir_fd, entry.name, 0);
+    }
+};
+
+static bool test_walk(off_t expected_size)
+{
+    // 1+4+16+64个目录
+    const int dir_number = 1 + 4 + 16 + 64;
+    CCollectVisitor visitor1(false), visitor4(false);
+    sys::CDirWalker walker1(1), walker4(4);
+    walker1.walk(sg_root, &visitor1);
+    walker4.walk(sg_root, &visitor4);
+    printf("walk: %zu entries, %d links, %llu dirs\n", visitor4.paths.size(), visitor4.link_number,
+           static_cast<unsigned long long>(walker4.get_dir_number()));
+    if ((visitor1.paths != visitor4.paths) || (visitor4.paths.size() != static_cast<size_t>(dir_number*11))
+     || (visitor4.link_number != dir_number) || (walker4.get_dir_number() != static_cast<uint64_t>(dir_number-1))
+     || (walker4.get_entry_number() != static_cast<uint64_t>(dir_number*11)) || (walker4.get_error_number() != 0))
+        return false;
+
+    // 跳过所有名为dir0的子目录
+    CCollectVisitor skip_visitor(true);
+    sys::CDirWalker walker(3, true);
+    walker.walk(sg_root, &skip_visitor);
+    if (skip_visitor.paths.size() != static_cast<size_t>((1+3+9+27)*11))
+        return false;
+
+    const off_t size1 = sys::CUtils::du(sg_root);
+    const off_t size4 = sys::CUtils::du(sg_root, 4);
+    printf("du: %ld, %ld, expected %ld\n", static_cast<long>(size1), static_cast<long>(size4), static_cast<long>(expected_size));
+    return (size1 == expected_size) && (size4 == expected_size) && (-1 == sys::CUtils::du("/tmp/ut_dir_utils.none"));
+}
+
+static bool test_unlink()
+{
+    CUnlinkVisitor visitor;
+    sys::CDirWalker walker(4);
+    walker.walk(sg_root, &visitor);
+
+    CCollectVisitor collect_visitor(false);
+    sys::CDirWalker collect_walker(2);
+    collect_walker.walk(sg_root, &collect_visitor);
+    return collect_visitor.paths.empty() && (0 == sys::CUtils::du(sg_root, 2));
+}
+
+int main()
+{
+    if (0 != system("rm -rf /tmp/ut_dir_utils"))
+        return 1;
+
+    try
+    {
+        const off_t size = make_tree(sg_root, 3);
+        if (!test_walk(size))
+            return 1;
+        if (!test_unlink())
+            return 1;
+
+        try
+        {
+            CUnlinkVisitor visitor;
+            sys::CDirWalker walker;
+            walker.walk("/tmp/ut_dir_utils.none", &visitor);
+            return 1;
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            printf("expected: %s\n", ex.str().c_str());
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    if (0 != system("rm -rf /tmp/ut_dir_utils"))
+        return 1;
+    printf("dir utils ok\n");
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include <mooon/sys/disk_queue.h>
+#include <mooon/sys/dir_utils.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/exception.h>
+#include <mooon/utils/string_utils.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+using namespace mooon;
+
+static const char* sg_directory = "/tmp/ut_disk_queue";
+
+// 第i条记录的内容，长度在0到3000之间
+static std::string make_record(int i)
+{
+    std::string record = utils::CStringUtils::format_string("record-%d:", i);
+    record.append(static_cast<size_t>((i * 7919) % 3000), static_cast<char>('a' + i % 26));
+    return record;
+}
+
+static void remove_directory()
+{
+    std::vector<std::string> filenames;
+    if (!sys::CDirUtils::exist(sg_directory))
+        return;
+    sys::CDirUtils::list(sg_directory, NULL, &filenames);
+    for (std::vector<std::string>::size_type i=0; i<filenames.size(); ++i)
+        (void)unlink((std::string(sg_directory) + "/" + filenames[i]).c_str());
+}
+
+static int count_files(const char* suffix)
+{
+    int count = 0;
+    std::vector<std::string> filenames;
+    sys::CDirUtils::list(sg_directory, NULL, &filenames);
+    for (std::vector<std::string>::size_type i=0; i<filenames.size(); ++i)
+    {
+        const size_t suffix_size = strlen(suffix);
+        if ((filenames[i].size() > suffix_size) && (0 == filenames[i].compare(filenames[i].size()-suffix_size, suffix_size, suffix)))
+            ++count;
+    }
+    return count;
+}
+
+static sys::CDiskQueuePolicy make_policy()
+{
+    sys::CDiskQueuePolicy policy;
+    policy.segment_size = 64 * 1024;
+    policy.spare_segments = 2;
+    return policy;
+}
+
+// 读出的记录须依次为第first条开始的number条
+static bool check_records(sys::CDiskQueue* queue, int first, int number)
+{
+    std::vector<std::string_view> records;
+    for (int i=first; i<first+number; )
+    {
+        const size_t count = queue->peek(&records, 50);
+        if (0 == count)
+        {
+            printf("queue empty at %d\n", i);
+            return false;
+        }
+        for (size_t j=0; j<count; ++j, ++i)
+        {
+            if (records[j] != make_record(i))
+            {
+                printf("record %d mismatch: %.*s\n", i, static_cast<int>(std::min<size_t>(records[j].size(), 20)), records[j].data());
+                return false;
+            }
+        }
+        queue->pop(count);
+    }
+    return true;
+}
+
+static bool test_basic()
+{
+    sys::CDiskQueue queue;
+    queue.open(sg_directory, make_policy());
+
+    for (int i=0; i<1000; ++i)
+    {
+        const std::string record = make_record(i);
+        if (!queue.push(record.data(), static_cast<uint32_t>(record.size())))
+            return false;
+    }
+    printf("segments: %u, bytes: %" PRIu64"\n", queue.get_segment_number(), queue.get_bytes());
+    if ((queue.get_record_number() != 1000) || (queue.get_segment_number() < 10))
+        return false;
+
+    std::string_view record;
+    if (!queue.front(&record) || (record != make_record(0)))
+        return false;
+    if (!check_records(&queue, 0, 300))
+        return false;
+    queue.close();
+
+    // 重新打开后从消费位置继续，消费完的段已回收，最多保留spare_segments个备用
+    queue.open(sg_directory, make_policy());
+    if ((queue.get_record_number() != 700) || (count_files(".spare") != 2))
+    {
+        printf("reopen: %" PRIu64" records, %d spares\n", queue.get_record_number(), count_files(".spare"));
+        return false;
+    }
+
+    // 复用备用段写入，残留的旧记录不应出现
+    for (int i=1000; i<1300; ++i)
+    {
+        const std::string record = make_record(i);
+        queue.push(record.data(), static_cast<uint32_t>(record.size()));
+    }
+    queue.close();
+    queue.open(sg_directory, make_policy());
+    if ((queue.get_record_number() != 1000) || !check_records(&queue, 300, 1000) || !queue.empty())
+        return false;
+
+    queue.close();
+    return count_files(".dq") <= 1;
+}
+
+// 进程崩溃（未刷盘即退出）时，已写入的记录不丢，未刷盘的消费位置之后的记录被再次读出
+static bool test_crash()
+{
+    sys::CDiskQueuePolicy policy = make_policy();
+    policy.sync_bytes = 0;
+    policy.sync_milliseconds = 0;
+
+    remove_directory();
+    {
+        sys::CDiskQueue queue;
+        queue.open(sg_directory, policy);
+        for (int i=0; i<100; ++i)
+        {
+            const std::string record = make_record(i);
+            queue.push(record.data(), static_cast<uint32_t>(record.size()));
+        }
+        queue.pop(10);
+        queue.sync();
+    }
+
+    const pid_t pid = fork();
+    if (0 == pid)
+    {
+        sys::CDiskQueue queue;
+        queue.open(sg_directory, policy);
+        for (int i=100; i<200; ++i)
+        {
+            const std::string record = make_record(i);
+            queue.push(record.data(), static_cast<uint32_t>(record.size()));
+        }
+        queue.pop(50);
+
+        // 再写一条不完整的记录（未commit）
+        char* reserved = queue.reserve(100);
+        memset(reserved, 'x', 100);
+        _exit(0);
+    }
+    int status = 0;
+    (void)waitpid(pid, &status, 0);
+
+    sys::CDiskQueue queue;
+    queue.open(sg_directory, policy);
+    if (queue.get_record_number() != 190)
+    {
+        printf("crash: %" PRIu64" records\n", queue.get_record_number());
+        return false;
+    }
+    return check_records(&queue, 10, 190) && queue.empty();
+}
+
+// 尾部损坏的记录及其后的都被丢弃
+static bool test_corruption()
+{
+    remove_directory();
+    {
+        sys::CDiskQueue queue;
+        queue.open(sg_directory, make_policy());
+        for (int i=0; i<5; ++i)
+        {
+            const std::string record = make_record(i);
+            queue.push(record.data(), static_cast<uint32_t>(record.size()));
+        }
+    }
+
+    // 第4条记录（第3条之后）的数据改掉一个字节
+    const std::string path = std::string(sg_directory) + "/00000000000000000000.dq";
+    size_t offset = 0;
+    for (int i=0; i<3; ++i)
+        offset += 8 + ((make_record(i).size() + 7) & ~7);
+    const int fd = open(path.c_str(), O_RDWR);
+    if ((-1 == fd) || (pwrite(fd, "#", 1, offset + 8 + 3) != 1))
+        return false;
+    close(fd);
+
+    sys::CDiskQueue queue;
+    queue.open(sg_directory, make_policy());
+    return (3 == queue.get_record_number()) && check_records(&queue, 0, 3);
+}
+
+// 零拷贝写入和满
+static bool test_reserve_and_full()
+{
+    sys::CDiskQueuePolicy policy = make_policy();
+    policy.max_segments = 2;
+
+    remove_directory();
+    sys::CDiskQueue queue;
+    queue.open(sg_directory, policy);
+
+    char* reserved = queue.reserve(1000);
+    const int n = snprintf(reserved, 1000, "zero copy");
+    queue.commit(static_cast<uint32_t>(n));
+    std::string_view record;
+    if (!queue.front(&record) || (record != "zero copy"))
+        return false;
+    queue.pop();
+
+    int pushed = 0;
+    const std::string data(4000, 'z');
+    while (queue.push(data.data(), static_cast<uint32_t>(data.size())))
+        ++pushed;
+    printf("pushed %d before full\n", pushed);
+    if ((queue.get_segment_number() != 2) || (pushed < 20))
+        return false;
+
+    // 读完第一个段后可以再写
+    queue.pop(16);
+    if (!queue.push(data.data(), static_cast<uint32_t>(data.size())))
+        return false;
+
+    try
+    {
+        (void)queue.reserve(64 * 1024);
+        return false;
+    }
+    catch (utils::CException&)
+    {
+    }
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        remove_directory();
+        if (!test_basic())
+            return 1;
+        if (!test_crash())
+            return 1;
+        if (!test_corruption())
+            return 1;
+        if (!test_reserve_and_full())
+            return 1;
+        remove_directory();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("disk queue ok\n");
+    return 0;
+}
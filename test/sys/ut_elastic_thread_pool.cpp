@@ -0,0 +1,95 @@
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/pool_thread.h>
+#include <mooon/sys/thread_pool.h>
+#include <mooon/sys/utils.h>
+#include <stdio.h>
+MOOON_NAMESPACE_USE
+
+// run须定期返回，缩容时stop才能等到线程退出
+class CTestThread: public sys::CPoolThread
+{
+private:
+    virtual void run()
+    {
+        do_millisleep(10);
+    }
+};
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { printf("line %d: %s\n", __LINE__, #condition); return 1; } \
+    } while (0)
+
+int main()
+{
+    sys::CElasticPolicy policy;
+    policy.min_thread_count = 2;
+    policy.max_thread_count = 5;
+    policy.grow_step = 2;
+    policy.wait_p99_threshold_ns = 1000*1000;
+    policy.backlog_per_thread = 100;
+    policy.cooldown_seconds = 1;
+    policy.name = "ut";
+
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    sys::CThreadPool<CTestThread> thread_pool;
+    thread_pool.create_elastic(policy);
+    thread_pool.activate();
+    EXPECT(thread_pool.is_elastic());
+    EXPECT(thread_pool.get_thread_count() == 2);
+    EXPECT(thread_pool.get_max_thread_count() == 5);
+    EXPECT(registry->get_gauge("thread_pool.ut.threads")->get() == 2);
+
+    // 积压超过“线程数*backlog_per_thread”时扩容
+    uint64_t now = 1000;
+    EXPECT(thread_pool.adjust(200, now) == 0);
+    EXPECT(thread_pool.adjust(201, now) == 2);
+    EXPECT(thread_pool.get_thread_count() == 4);
+
+    // 等待时长的p99超过阈值时扩容，不超过最多的线程数
+    for (int i=0; i<100; ++i)
+        thread_pool.record_wait(5*1000*1000);
+    EXPECT(thread_pool.adjust(0, now) == 1);
+    EXPECT(thread_pool.get_thread_count() == 5);
+    EXPECT(thread_pool.get_thread(4) != NULL);
+    for (int i=0; i<100; ++i)
+        thread_pool.record_wait(5*1000*1000);
+    EXPECT(thread_pool.adjust(0, now) == 0);
+    EXPECT(registry->get_counter("thread_pool.ut.scale_up")->get() == 3);
+
+    // 快照已被重置，未超过阈值的等待不扩容
+    for (int i=0; i<100; ++i)
+        thread_pool.record_wait(1000);
+    EXPECT(thread_pool.adjust(0, now) == 0); // 开始空闲
+    EXPECT(thread_pool.adjust(0, now+999) == 0);
+    EXPECT(thread_pool.adjust(0, now+1000) == -1);
+    EXPECT(thread_pool.get_thread_count() == 4);
+
+    // 每个冷却周期只退一个，有积压时重新计时
+    EXPECT(thread_pool.adjust(0, now+1500) == 0);
+    EXPECT(thread_pool.adjust(10, now+2000) == 0);
+    EXPECT(thread_pool.adjust(0, now+2500) == 0);
+    EXPECT(thread_pool.adjust(0, now+3000) == 0);
+    EXPECT(thread_pool.adjust(0, now+3500) == -1);
+    EXPECT(thread_pool.adjust(0, now+4500) == -1);
+    EXPECT(thread_pool.adjust(0, now+9000) == 0); // 不少于最少的线程数
+    EXPECT(thread_pool.get_thread_count() == 2);
+    EXPECT(registry->get_counter("thread_pool.ut.scale_down")->get() == 3);
+    EXPECT(registry->get_gauge("thread_pool.ut.threads")->get() == 2);
+
+    // 退掉后可再扩容
+    EXPECT(thread_pool.adjust(1000) == 2);
+    EXPECT(thread_pool.get_thread_count() == 4);
+    thread_pool.destroy();
+    EXPECT(registry->get_gauge("thread_pool.ut.threads")->get() == 0);
+
+    // 非弹性线程池不伸缩
+    sys::CThreadPool<CTestThread> fixed_pool;
+    fixed_pool.create(3);
+    EXPECT(!fixed_pool.is_elastic());
+    EXPECT(fixed_pool.adjust(100000) == 0);
+    fixed_pool.destroy();
+
+    printf("elastic thread pool ok\n");
+    return 0;
+}
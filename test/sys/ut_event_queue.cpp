@@ -27,6 +27,12 @@ MOOON_NAMESPACE_USE
 
 static int g_times = 1000000;
 
+static void push_later(sys::CEventQueue<utils::CArrayQueue<int> >* queue)
+{
+    sys::CUtils::millisleep(1);
+    (void)queue->push_back(2018);
+}
+
 class CMyThread
 {
 public:
@@ -89,8 +95,47 @@ private:
     //sys::CEventQueue<sys::CEventQueueAdapterForList<int> > _queue;
 };
 
+// 批量入队放入放得下的，批量出队取走已有的，并且只在有等待者时发信号
+static bool test_batch()
+{
+    sys::CEventQueue<utils::CArrayQueue<int> > queue(8, 10, 10);
+    int elem_array[16];
+    for (int i=0; i<16; ++i)
+        elem_array[i] = i;
+
+    uint32_t array_size = 16;
+    if (!queue.push_back_batch(elem_array, array_size) || (8 != array_size) || (8 != queue.size()))
+        return false;
+    array_size = 1;
+    if (queue.push_back_batch(elem_array, array_size) || (0 != array_size))
+        return false;
+
+    int popped_array[16];
+    array_size = 5;
+    if (!queue.pop_front_batch(popped_array, array_size) || (5 != array_size) || (0 != popped_array[0]) || (4 != popped_array[4]))
+        return false;
+    array_size = 16;
+    if (!queue.pop_front_batch(popped_array, array_size) || (3 != array_size) || (7 != popped_array[2]))
+        return false;
+    array_size = 16;
+    if (queue.pop_front_batch(popped_array, array_size) || (0 != array_size))
+        return false;
+
+    // 自旋期间另一个线程放入，不需要进入等待
+    queue.set_spin_number(1000000);
+    sys::CThreadEngine engine(sys::bind(&push_later, &queue));
+    int elem = -1;
+    const bool popped = queue.pop_front(elem);
+    engine.join();
+    printf("batch ok, popped %d after spin\n", elem);
+    return popped && (2018 == elem);
+}
+
 int main(int argc, char* argv[])
 {
+    if (!test_batch())
+        return 1;
+
     int i;
     const int num_threads = (1 == argc)? 6: atoi(argv[1])+1;
     CMyThread* my_thread[num_threads];
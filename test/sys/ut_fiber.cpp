@@ -0,0 +1,180 @@
+#include "mooon/sys/clock.h"
+#include "mooon/sys/fiber.h"
+#include "mooon/sys/utils.h"
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace mooon;
+
+#define FIBER_NUMBER 10000
+
+static volatile int sg_finished = 0;
+
+static void sleep_three_times()
+{
+    for (int i=0; i<3; ++i)
+        sys::CUtils::millisleep(10); // 纤程中只挂起纤程
+    __atomic_add_fetch(&sg_finished, 1, __ATOMIC_RELAXED);
+}
+
+// 一万个纤程各睡眠3次，用时接近30毫秒而不是线程池的排队时间
+static bool test_sleep()
+{
+    sys::CFiberScheduler scheduler;
+    scheduler.create(4, 32*1024);
+
+    const uint64_t start = sys::CClock::get_milliseconds();
+    for (int i=0; i<FIBER_NUMBER; ++i)
+        scheduler.spawn(sys::bind(&sleep_three_times));
+    scheduler.destroy();
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - start;
+
+    printf("sleep: %d fibers in %" PRIu64"ms, %" PRIu64" switches, %" PRIu64" stolen\n",
+           sg_finished, milliseconds, scheduler.get_switch_number(), scheduler.get_steal_number());
+    return (FIBER_NUMBER == sg_finished) && (milliseconds < 3000);
+}
+
+struct LockContext
+{
+    sys::CFiberLock lock;
+    sys::CFiberEvent event;
+    int counter;
+    int produced;
+    int consumed;
+    int timeout_number;
+};
+
+static void increase(LockContext* context)
+{
+    for (int i=0; i<1000; ++i)
+    {
+        sys::LockHelper<sys::CFiberLock> lock_helper(context->lock);
+        const int counter = context->counter;
+        if (0 == i % 100)
+            sys::CFiberScheduler::yield(); // 持锁让出，其它纤程在锁上挂起
+        context->counter = counter + 1;
+    }
+}
+
+static void consume(LockContext* context)
+{
+    sys::LockHelper<sys::CFiberLock> lock_helper(context->lock);
+    while (context->consumed < 1000)
+    {
+        if (context->produced > context->consumed)
+            ++context->consumed;
+        else if (!context->event.timed_wait(context->lock, 1000))
+            break;
+    }
+}
+
+static void produce(LockContext* context)
+{
+    for (int i=0; i<1000; ++i)
+    {
+        sys::LockHelper<sys::CFiberLock> lock_helper(context->lock);
+        ++context->produced;
+        context->event.signal();
+    }
+}
+
+static void wait_timeout(LockContext* context)
+{
+    sys::CFiberEvent event;
+    sys::LockHelper<sys::CFiberLock> lock_helper(context->lock);
+    if (!event.timed_wait(context->lock, 20))
+        ++context->timeout_number;
+}
+
+static bool test_lock_and_event()
+{
+    LockContext context;
+    context.counter = 0;
+    context.produced = 0;
+    context.consumed = 0;
+    context.timeout_number = 0;
+
+    sys::CFiberScheduler scheduler;
+    scheduler.create(3);
+    for (int i=0; i<100; ++i)
+        scheduler.spawn(sys::bind(&increase, &context));
+    scheduler.spawn(sys::bind(&consume, &context));
+    scheduler.spawn(sys::bind(&produce, &context));
+    for (int i=0; i<10; ++i)
+        scheduler.spawn(sys::bind(&wait_timeout, &context));
+    scheduler.destroy();
+
+    printf("lock: counter=%d, produced=%d, consumed=%d, timeout=%d\n", context.counter, context.produced, context.consumed, context.timeout_number);
+    return (100*1000 == context.counter) && (1000 == context.consumed) && (10 == context.timeout_number);
+}
+
+struct PollContext
+{
+    int fds[2];
+    bool readable;
+    bool timed_out;
+    uint64_t waited_milliseconds;
+};
+
+static void poll_reader(PollContext* context)
+{
+    // 没有数据时超时
+    context->timed_out = !sys::CFiberScheduler::poll(context->fds[0], POLLIN, 20);
+
+    const uint64_t start = sys::CClock::get_milliseconds();
+    int revents = 0;
+    context->readable = sys::CFiberScheduler::poll(context->fds[0], POLLIN, 1000, &revents) && (revents & POLLIN);
+    context->waited_milliseconds = sys::CClock::get_milliseconds() - start;
+}
+
+static void poll_writer(PollContext* context)
+{
+    sys::CFiberScheduler::sleep(50);
+    if (write(context->fds[1], "x", 1) != 1)
+        fprintf(stderr, "write error: %s\n", strerror(errno));
+}
+
+// 只有一个载体线程，reader在poll时writer能运行
+static bool test_poll()
+{
+    PollContext context;
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, context.fds))
+        return false;
+    context.readable = false;
+    context.timed_out = false;
+    context.waited_milliseconds = 0;
+
+    sys::CFiberScheduler scheduler;
+    scheduler.create(1);
+    scheduler.spawn(sys::bind(&poll_reader, &context));
+    scheduler.spawn(sys::bind(&poll_writer, &context));
+    scheduler.destroy();
+    close(context.fds[0]);
+    close(context.fds[1]);
+
+    printf("poll: timed_out=%d, readable=%d after %" PRIu64"ms\n", context.timed_out, context.readable, context.waited_milliseconds);
+    return context.timed_out && context.readable && (context.waited_milliseconds < 1000);
+}
+
+int main()
+{
+    try
+    {
+        if (!test_sleep())
+            return 1;
+        if (!test_lock_and_event())
+            return 1;
+        if (!test_poll())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("fiber ok\n");
+    return 0;
+}
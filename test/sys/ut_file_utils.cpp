@@ -0,0 +1,119 @@
+#include "mooon/sys/file_utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace mooon;
+
+#define FILE_SIZE (5*1024*1024+123)
+
+static const char* sg_src = "/tmp/ut_file_utils.src";
+static const char* sg_dst = "/tmp/ut_file_utils.dst";
+
+static bool write_file(const char* filepath, const std::string& data)
+{
+    FILE* fp = fopen(filepath, "w");
+    if (NULL == fp)
+        return false;
+    const bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+static bool test_file_copy()
+{
+    unlink(sg_dst);
+    if ((sys::CFileUtils::file_copy(sg_src, sg_dst) != FILE_SIZE) || !sys::CFileUtils::compare(sg_src, sg_dst))
+        return false;
+
+    // 目的文件已存在时失败，权限模式同源文件
+    struct stat st;
+    if ((-1 == stat(sg_dst, &st)) || ((st.st_mode & 0777) != 0640))
+        return false;
+    try
+    {
+        sys::CFileUtils::file_copy(sg_src, sg_dst);
+        return false;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+
+    // 源为管道时退回read和write
+    int fds[2];
+    if (-1 == pipe(fds))
+        return false;
+    if (write(fds[1], "hello", 5) != 5)
+        return false;
+    close(fds[1]);
+    unlink(sg_dst);
+    int dst_fd = open(sg_dst, O_WRONLY|O_CREAT|O_EXCL, 0600);
+    const size_t size = sys::CFileUtils::file_copy(fds[0], dst_fd);
+    close(fds[0]);
+    close(dst_fd);
+    printf("pipe copy: %zu\n", size);
+    return (5 == size) && (5 == sys::CFileUtils::get_file_size(sg_dst));
+}
+
+static bool test_parallel_copy_and_compare()
+{
+    unlink(sg_dst);
+    if ((sys::CFileUtils::parallel_file_copy(sg_src, sg_dst, 1024*1024, 3) != FILE_SIZE)
+     || !sys::CFileUtils::compare(sg_src, sg_dst, 3))
+        return false;
+
+    // 最后一块中的一个字节不同
+    int fd = open(sg_dst, O_WRONLY);
+    const bool written = pwrite(fd, "X", 1, FILE_SIZE-10) == 1;
+    close(fd);
+    if (!written || sys::CFileUtils::compare(sg_src, sg_dst, 2) || sys::CFileUtils::compare(sg_src, sg_dst))
+        return false;
+
+    // 大小不同，或文件不存在
+    if (!write_file(sg_dst, "abc"))
+        return false;
+    return !sys::CFileUtils::compare(sg_src, sg_dst) && !sys::CFileUtils::compare(sg_src, "/tmp/ut_file_utils.none");
+}
+
+static bool test_copy_md5sum()
+{
+    unlink(sg_dst);
+    std::string md5_str, expected;
+    if (sys::CFileUtils::file_copy_md5sum(sg_src, sg_dst, &md5_str) != FILE_SIZE)
+        return false;
+    sys::CFileUtils::md5sum(&expected, sg_src);
+    printf("copy md5sum: %s\n", md5_str.c_str());
+    return (md5_str == expected) && sys::CFileUtils::compare(sg_src, sg_dst, 2);
+}
+
+int main()
+{
+    std::string data(FILE_SIZE, '\0');
+    for (size_t i=0; i<data.size(); ++i)
+        data[i] = static_cast<char>(rand());
+    if (!write_file(sg_src, data) || (-1 == chmod(sg_src, 0640)))
+        return 1;
+
+    try
+    {
+        if (!test_file_copy())
+            return 1;
+        if (!test_parallel_copy_and_compare())
+            return 1;
+        if (!test_copy_md5sum())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    unlink(sg_src);
+    unlink(sg_dst);
+    printf("file utils ok\n");
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "mooon/sys/flight_recorder.h"
+#include "mooon/sys/signal_handler.h"
+#include "mooon/sys/syscall_exception.h"
+#include "mooon/utils/exception.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+using namespace mooon;
+
+enum { EVENT_VALUE = 1, EVENT_TEXT = 2, EVENT_UNNAMED = 2000 };
+
+static const sys::flight_thread_t* find_thread(const sys::CFlightReader& reader, const char* thread_name)
+{
+    for (size_t i=0; i<reader.get_threads().size(); ++i)
+    {
+        if (reader.get_threads()[i].thread_name == thread_name)
+            return &reader.get_threads()[i];
+    }
+    return NULL;
+}
+
+static const char* get_text()
+{
+    return "a long text payload which is longer than forty-eight bytes";
+}
+
+static void* record_thread(void*)
+{
+    (void)pthread_setname_np(pthread_self(), "ut_recorder");
+    const char* text = get_text();
+    sys::CFlightRecorder::record(EVENT_TEXT, text, strlen(text));
+    MOOON_FLIGHT_RECORD(EVENT_UNNAMED);
+    return NULL;
+}
+
+static bool run_thread()
+{
+    pthread_t thread;
+    return (0 == pthread_create(&thread, NULL, record_thread, NULL)) && (0 == pthread_join(thread, NULL));
+}
+
+static bool test_record()
+{
+    const std::string filename = "ut_flight_recorder.flight";
+    MOOON_FLIGHT_RECORD(EVENT_VALUE, 1); // 未启用，不记录
+    sys::CFlightRecorder::name_event(EVENT_VALUE, "value");
+    sys::CFlightRecorder::name_event(EVENT_TEXT, "text");
+    sys::CFlightRecorder::enable(true, 7);
+
+    (void)pthread_setname_np(pthread_self(), "ut_main");
+    for (int i=0; i<20; ++i)
+        MOOON_FLIGHT_RECORD(EVENT_VALUE, i, i * 10);
+    if (!run_thread() || !run_thread()) // 第二个线程重用第一个退出后的缓冲区
+        return false;
+
+    sys::CFlightRecorder::dump(filename);
+    sys::CFlightReader reader;
+    reader.open(filename);
+    (void)unlink(filename.c_str());
+
+    const sys::flight_thread_t* main_thread = find_thread(reader, "ut_main");
+    const sys::flight_thread_t* other_thread = find_thread(reader, "ut_recorder");
+    if ((reader.get_threads().size() != 2) || (NULL == main_thread) || (NULL == other_thread) || (reader.get_signo() != 0))
+        return false;
+
+    // 容量向上取整为8，只保留最后8个
+    if ((main_thread->event_number != 20) || (main_thread->events.size() != 8))
+        return false;
+    for (size_t i=0; i<main_thread->events.size(); ++i)
+    {
+        const std::string payload = sys::CFlightReader::format_payload(main_thread->events[i]);
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%d,%d", static_cast<int>(12+i), static_cast<int>((12+i)*10));
+        if ((payload != expected) || (reader.get_event_name(main_thread->events[i].event_id) != "value")
+         || ((i > 0) && (main_thread->events[i].timestamp_ns < main_thread->events[i-1].timestamp_ns)))
+        {
+            printf("event %zu: %s\n", i, payload.c_str());
+            return false;
+        }
+    }
+
+    // 负载被截断为48字节，没有命名的事件以ID显示
+    printf("%s %s %s\n", reader.get_datetime(other_thread->events[0].timestamp_ns).c_str(),
+           reader.get_event_name(other_thread->events[0].event_id).c_str(), sys::CFlightReader::format_payload(other_thread->events[0]).c_str());
+    return (other_thread->events.size() == 2) && (other_thread->events[0].payload_size == sys::FLIGHT_PAYLOAD_MAX)
+        && (sys::CFlightReader::format_payload(other_thread->events[0]) == std::string(get_text(), sys::FLIGHT_PAYLOAD_MAX))
+        && (reader.get_event_name(other_thread->events[1].event_id) == "event#2000")
+        && (other_thread->events[1].payload_size == 16);
+}
+
+// 子进程中记录事件后段错误，转储后仍以SIGSEGV终止
+static bool test_crash()
+{
+    const char* filename = "ut_flight_recorder.crash.flight";
+    (void)unlink(filename);
+
+    const pid_t pid = fork();
+    if (0 == pid)
+    {
+        struct rlimit rlimit = { 0, 0 };
+        (void)setrlimit(RLIMIT_CORE, &rlimit);
+        sys::CFlightRecorder::clear();
+        sys::CFlightRecorder::set_crash_filename(filename);
+        if (!sys::CSignalHandler::handle_fatal_signals(sys::CFlightRecorder::dump_on_signal))
+            _exit(1);
+
+        MOOON_FLIGHT_RECORD(EVENT_VALUE, 2024, 1);
+        volatile int* p = NULL;
+        *p = 1;
+        _exit(2);
+    }
+
+    int status = 0;
+    if ((-1 == pid) || (waitpid(pid, &status, 0) != pid) || !WIFSIGNALED(status) || (WTERMSIG(status) != SIGSEGV))
+        return false;
+
+    sys::CFlightReader reader;
+    reader.open(filename);
+    (void)unlink(filename);
+
+    const sys::flight_thread_t* main_thread = find_thread(reader, "ut_main");
+    printf("crash: pid=%u, signo=%d, %zu threads\n", reader.get_pid(), reader.get_signo(), reader.get_threads().size());
+    return (reader.get_signo() == SIGSEGV) && (reader.get_pid() == static_cast<uint32_t>(pid))
+        && (main_thread != NULL) && (1 == main_thread->events.size())
+        && (sys::CFlightReader::format_payload(main_thread->events[0]) == "2024,1");
+}
+
+int main()
+{
+    try
+    {
+        if (!test_record() || !test_crash())
+        {
+            printf("flight recorder failed\n");
+            return 1;
+        }
+
+        // 不是转储文件
+        bool thrown = false;
+        try
+        {
+            sys::CFlightReader reader;
+            reader.open("/proc/self/status");
+        }
+        catch (utils::CException& ex)
+        {
+            thrown = true;
+        }
+        if (!thrown)
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("flight recorder ok\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <mooon/sys/clock.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/event_queue.h>
+#include <mooon/sys/futex_event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/array_queue.h>
+#include <stdio.h>
+MOOON_NAMESPACE_USE
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { printf("line %d: %s\n", __LINE__, #condition); return 1; } \
+    } while (0)
+
+static sys::CLock sg_lock;
+static sys::CFutexEvent sg_event;
+static int sg_ready = 0;
+static volatile int sg_woken_number = 0;
+
+// 等到sg_ready大于0后取走一个
+static void wait_ready()
+{
+    sys::LockHelper<sys::CLock> lh(sg_lock);
+    while (0 == sg_ready)
+        sg_event.wait(sg_lock);
+    --sg_ready;
+    __atomic_add_fetch(&sg_woken_number, 1, __ATOMIC_SEQ_CST);
+}
+
+static sys::CFutexSemaphore sg_semaphore;
+
+static void acquire_semaphore()
+{
+    sg_semaphore.wait();
+    __atomic_add_fetch(&sg_woken_number, 1, __ATOMIC_SEQ_CST);
+}
+
+static void wait_all_waiting(uint32_t number)
+{
+    while (sg_event.get_waiter_number() < number)
+        sys::CUtils::millisleep(1);
+}
+
+static void push_later(sys::CEventQueue<utils::CArrayQueue<int>, sys::CFutexEvent>* queue)
+{
+    sys::CUtils::millisleep(10);
+    (void)queue->push_back(2015);
+}
+
+int main()
+{
+    // CEvent默认按单调时钟计时，超时时长不受系统时间影响
+    {
+        sys::CLock lock;
+        sys::CEvent event;
+        sys::CEvent realtime_event(false);
+        sys::LockHelper<sys::CLock> lh(lock);
+
+        const uint64_t begin = sys::CClock::get_milliseconds();
+        EXPECT(!event.timed_wait(lock, 20));
+        EXPECT(!realtime_event.timed_wait(lock, 20));
+        EXPECT(sys::CClock::get_milliseconds() - begin >= 40);
+        event.wake_n(3); // 没有等待者时忽略
+    }
+
+    // 超时和没有等待者时的唤醒
+    {
+        sys::LockHelper<sys::CLock> lh(sg_lock);
+        const uint64_t begin = sys::CClock::get_milliseconds();
+        EXPECT(!sg_event.timed_wait(sg_lock, 20));
+        EXPECT(sys::CClock::get_milliseconds() - begin >= 20);
+        EXPECT(0 == sg_event.get_waiter_number());
+        sg_event.broadcast();
+
+        // 检查条件之后到等待之前的唤醒不会丢失
+        const uint32_t epoch = sg_event.prepare_wait();
+        sg_event.signal();
+        EXPECT(sg_event.wait_for(epoch, 1000));
+    }
+
+    // wake_n只唤醒n个等待者
+    {
+        sys::CThreadEngine* engines[4];
+        for (int i=0; i<4; ++i)
+            engines[i] = new sys::CThreadEngine(sys::bind(&wait_ready));
+        wait_all_waiting(4);
+
+        {
+            sys::LockHelper<sys::CLock> lh(sg_lock);
+            sg_ready = 2;
+            sg_event.wake_n(2);
+        }
+        while (sg_woken_number < 2)
+            sys::CUtils::millisleep(1);
+
+        sys::CUtils::millisleep(20);
+        EXPECT(2 == sg_woken_number);
+        wait_all_waiting(2);
+        {
+            sys::LockHelper<sys::CLock> lh(sg_lock);
+            sg_ready = 2;
+            sg_event.broadcast();
+        }
+        for (int i=0; i<4; ++i)
+        {
+            engines[i]->join();
+            delete engines[i];
+        }
+        EXPECT(4 == sg_woken_number);
+    }
+
+    // 信号量
+    {
+        EXPECT(!sg_semaphore.try_wait());
+        EXPECT(!sg_semaphore.timed_wait(10));
+        sg_semaphore.post(2);
+        EXPECT(2 == sg_semaphore.get_value());
+        EXPECT(sg_semaphore.try_wait());
+        EXPECT(sg_semaphore.timed_wait(10));
+
+        sg_woken_number = 0;
+        sys::CThreadEngine* engines[3];
+        for (int i=0; i<3; ++i)
+            engines[i] = new sys::CThreadEngine(sys::bind(&acquire_semaphore));
+        sys::CUtils::millisleep(10);
+        sg_semaphore.post(3);
+        for (int i=0; i<3; ++i)
+        {
+            engines[i]->join();
+            delete engines[i];
+        }
+        EXPECT(3 == sg_woken_number);
+        EXPECT(0 == sg_semaphore.get_value());
+    }
+
+    // 以CFutexEvent为通知事件的队列
+    {
+        sys::CEventQueue<utils::CArrayQueue<int>, sys::CFutexEvent> queue(4, 1000, 0);
+        sys::CThreadEngine engine(sys::bind(&push_later, &queue));
+
+        int elem = 0;
+        EXPECT(queue.pop_front(elem));
+        EXPECT(2015 == elem);
+        engine.join();
+
+        for (int i=0; i<4; ++i)
+            EXPECT(queue.push_back(i));
+        EXPECT(!queue.push_back(4));
+    }
+
+    printf("futex event ok\n");
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <mooon/sys/hedge.h>
+#include <mooon/sys/utils.h>
+#include <stdio.h>
+#include <string>
+using namespace mooon;
+
+// 首次调用慢（或失败），对冲调用快
+class CSlowAttempt: public sys::IHedgedAttempt<std::string>
+{
+public:
+    CSlowAttempt(uint32_t slow_milliseconds, bool primary_fails)
+        : _slow_milliseconds(slow_milliseconds), _primary_fails(primary_fails)
+    {
+    }
+
+private:
+    virtual bool call(uint32_t attempt, const sys::CCancellationToken& token, std::string* result)
+    {
+        if (0 == attempt)
+        {
+            if (_primary_fails)
+                THROW_EXCEPTION("primary failed", -1);
+            // 可中断地等待，被取消时尽早放弃
+            for (uint32_t i=0; (i<_slow_milliseconds) && !token.is_cancelled(); ++i)
+                sys::CUtils::millisleep(1);
+            if (token.is_cancelled())
+                return false;
+        }
+
+        *result = (0 == attempt)? "primary": "hedge";
+        return true;
+    }
+
+private:
+    uint32_t _slow_milliseconds;
+    bool _primary_fails;
+};
+
+static bool test_hedged_call()
+{
+    sys::CTaskExecutor executor;
+    executor.create(4);
+
+    sys::CHedgePolicy policy;
+    policy.name = "ut";
+    policy.delay_milliseconds = 20;
+    policy.budget_percent = 0;
+    policy.budget_burst = 1;
+    sys::CHedgeController controller(policy);
+    std::string result;
+    uint32_t winner = 0;
+
+    // 慢的首次调用被对冲，对冲的先返回
+    const uint64_t begin = sys::CClock::get_milliseconds();
+    if (!sys::hedged_call(&executor, &controller, new CSlowAttempt(1000, false), &result, &winner) || (result != "hedge") || (winner != 1))
+        return false;
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - begin;
+    printf("hedged: %" PRIu64 "ms\n", milliseconds);
+    if ((milliseconds < 20) || (milliseconds >= 500))
+        return false;
+
+    // 快的首次调用不对冲
+    if (!sys::hedged_call(&executor, &controller, new CSlowAttempt(0, false), &result, &winner) || (result != "primary") || (winner != 0))
+        return false;
+
+    // 预算用完后不再对冲，等首次调用
+    if (!sys::hedged_call(&executor, &controller, new CSlowAttempt(50, false), &result, &winner) || (result != "primary"))
+        return false;
+
+    // 首次调用在延迟内失败，不对冲（不是重试）
+    if (sys::hedged_call(&executor, &controller, new CSlowAttempt(0, true), &result))
+        return false;
+
+    const bool ok = (1 == controller.get_hedge_number()) && (1 == controller.get_won_number()) && (1 == controller.get_throttled_number())
+        && (1 == sys::CMetricsRegistry::get_singleton()->get_counter("hedge.ut.sent")->get());
+    executor.destroy();
+    return ok;
+}
+
+// 预算按请求数的百分比积攒，不超过burst
+static bool test_budget()
+{
+    sys::CHedgePolicy policy;
+    policy.budget_percent = 10;
+    policy.budget_burst = 2;
+    sys::CHedgeController controller(policy);
+
+    int hedges = 0;
+    for (int i=0; i<1000; ++i)
+    {
+        (void)controller.on_request();
+        if (controller.try_hedge())
+            ++hedges;
+    }
+    printf("budget: %d hedges per 1000 requests\n", hedges);
+    return (hedges >= 100) && (hedges <= 102);
+}
+
+// 对冲延迟跟随耗时的百分位
+static bool test_percentile()
+{
+    sys::CHedgePolicy policy;
+    policy.min_delay_milliseconds = 2;
+    policy.max_delay_milliseconds = 500;
+    sys::CHedgeController controller(policy);
+    if (controller.get_delay_milliseconds() != 500)
+        return false;
+
+    for (int i=0; i<sys::CHedgeController::SAMPLE_NUMBER; ++i)
+        controller.on_complete(((i % 100) < 95)? 5000000: 80000000, false);
+    const uint32_t delay = controller.get_delay_milliseconds();
+    for (int i=0; i<sys::CHedgeController::SAMPLE_NUMBER; ++i)
+        controller.on_complete(100000, false);
+
+    printf("percentile: %ums, then %ums\n", delay, controller.get_delay_milliseconds());
+    return (delay >= 5) && (delay <= 6) && (2 == controller.get_delay_milliseconds());
+}
+
+int main()
+{
+    if (!test_hedged_call())
+    {
+        printf("hedged call failed\n");
+        return 1;
+    }
+    if (!test_budget())
+    {
+        printf("budget failed\n");
+        return 1;
+    }
+    if (!test_percentile())
+    {
+        printf("percentile failed\n");
+        return 1;
+    }
+
+    printf("hedge ok\n");
+    return 0;
+}
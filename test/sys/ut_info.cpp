@@ -0,0 +1,195 @@
+#include "mooon/sys/clock.h"
+#include "mooon/sys/info.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/thread.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+using namespace mooon;
+
+// 进程名包含空格和括号时，之后的字段也能正确解析
+static bool test_process_info()
+{
+    char old_name[16] = { 0 };
+    (void)prctl(PR_GET_NAME, old_name);
+    (void)prctl(PR_SET_NAME, "ut (info) x");
+
+    sys::CInfo::process_info_t process_info;
+    const bool ok = sys::CInfo::get_process_info(process_info);
+    (void)prctl(PR_SET_NAME, old_name);
+
+    printf("process: pid=%d, comm=%s, state=%c, ppid=%d, threads=%" PRId64", vsize=%" PRIu64", rss=%" PRId64"\n",
+           process_info.pid, process_info.comm, process_info.state, process_info.ppid,
+           process_info.num_threads, process_info.vsize, process_info.rss);
+    return ok && (getpid() == process_info.pid) && (getppid() == process_info.ppid)
+        && (0 == strcmp(process_info.comm, "ut (info) x"))
+        && (1 == process_info.num_threads) && (process_info.vsize > 0) && (process_info.rss > 0);
+}
+
+static bool test_cpu_and_mem()
+{
+    sys::CInfo::cpu_info_t cpu_info;
+    std::vector<sys::CInfo::cpu_info_t> cpu_info_array;
+    sys::CInfo::mem_info_t mem_info;
+    sys::CInfo::process_page_info_t page_info;
+    if (!sys::CInfo::get_cpu_info(cpu_info) || !sys::CInfo::get_mem_info(mem_info) || !sys::CInfo::get_process_page_info(page_info))
+        return false;
+
+    // 第一个为总的，之后依次为各CPU
+    const int n = sys::CInfo::get_cpu_info_array(cpu_info_array);
+    printf("cpu: total=%" PRIu64", %d items, mem_total=%u, resident=%" PRId64"\n", cpu_info.total, n, mem_info.mem_total, page_info.resident);
+    return (cpu_info.total > 0) && (n == sysconf(_SC_NPROCESSORS_ONLN) + 1)
+        && (mem_info.mem_total > 0) && (page_info.resident > 0);
+}
+
+// 取所有网卡，以及按名字精确匹配
+static bool test_net_info()
+{
+    std::vector<sys::CInfo::net_info_t> net_info_array;
+    if (!sys::CInfo::get_net_info_array(net_info_array))
+        return false;
+
+    sys::CInfo::net_info_t net_info;
+    const char* interface_name = net_info_array.back().interface_name;
+    if (!sys::CInfo::get_net_info(interface_name, net_info) || (strcmp(net_info.interface_name, interface_name) != 0))
+        return false;
+
+    printf("net: %zu interfaces, last is %s\n", net_info_array.size(), interface_name);
+    return !sys::CInfo::get_net_info("l", net_info);
+}
+
+static bool test_sampler()
+{
+    sys::CInfoSampler sampler;
+    sys::CInfoSampler::resource_rates_t rates;
+    if (sampler.sample(&rates))
+        return false; // 第一次只建立基线
+
+    // 忙等200毫秒，进程CPU使用率应接近100
+    const uint64_t end = sys::CClock::get_milliseconds() + 200;
+    volatile uint64_t spin = 0;
+    while (sys::CClock::get_milliseconds() < end)
+        spin = spin + 1;
+    if (!sampler.sample(&rates))
+        return false;
+    printf("sample: %" PRIu64"ms, cpu=%.1f%%, process cpu=%.1f%%, context switches=%.0f/s, rss=%" PRIu64", %zu cpus, %zu interfaces\n",
+           rates.interval_milliseconds, rates.cpu_percent, rates.process_cpu_percent, rates.context_switches,
+           rates.process_rss, rates.cpu_percent_array.size(), rates.net_rate_array.size());
+    if ((rates.process_cpu_percent < 50) || (rates.cpu_percent <= 0) || (rates.process_rss <= 0)
+     || (rates.cpu_percent_array.size() != static_cast<size_t>(sysconf(_SC_NPROCESSORS_ONLN))))
+        return false;
+
+    sys::CInfoSampler::publish_metrics(rates);
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    if ((0 == snapshot.gauges.count("process.cpu_permille")) || (snapshot.gauges["process.rss_bytes"] <= 0))
+        return false;
+
+    // 每秒一次采样的开销应远低于1毫秒（0.1%的CPU）
+    const int number = 1000;
+    const uint64_t start = sys::CClock::get_microseconds();
+    for (int i=0; i<number; ++i)
+        (void)sampler.sample(&rates);
+    const uint64_t microseconds = (sys::CClock::get_microseconds() - start) / number;
+    printf("sample cost: %" PRIu64"us\n", microseconds);
+    return microseconds < 1000;
+}
+
+// 忙等或每10毫秒睡眠一次，直到被停止
+class CAccountingThread: public sys::CThread
+{
+public:
+    CAccountingThread(bool spin): _spin(spin), _named(false) {}
+    bool is_named() const { return _named; }
+
+private:
+    virtual void run()
+    {
+        char name[16] = { 0 };
+        _named = (0 == pthread_getname_np(pthread_self(), name, sizeof(name))) && (get_name().substr(0, 15) == name);
+        volatile uint64_t spin = 0;
+        while (!is_stop())
+        {
+            if (_spin)
+                spin = spin + 1;
+            else
+                do_millisleep(10);
+        }
+    }
+
+private:
+    bool _spin;
+    volatile bool _named;
+};
+
+static bool test_thread_sampler()
+{
+    // 当前线程以RUSAGE_THREAD取得，此前已忙等过
+    sys::CInfo::thread_times_t thread_times;
+    if (!sys::CInfo::get_current_thread_times(thread_times) || (0 == thread_times.user_microseconds + thread_times.system_microseconds))
+        return false;
+
+    CAccountingThread* spinner = new CAccountingThread(true);
+    CAccountingThread* sleeper = new CAccountingThread(false);
+    spinner->inc_refcount();
+    sleeper->inc_refcount();
+    spinner->set_name("ut.spinner");
+    sleeper->set_name("ut.sleeper.with.a.long.name");
+    spinner->start();
+    sleeper->start();
+    while (sys::CThreadSampler::get_registered_number() < 2)
+        sys::CUtils::millisleep(1);
+
+    sys::CThreadSampler sampler;
+    std::vector<sys::CThreadSampler::thread_rates_t> rates_array;
+    const bool first = sampler.sample(&rates_array);
+    sys::CUtils::millisleep(300);
+    const bool second = sampler.sample(&rates_array);
+    spinner->stop();
+    sleeper->stop();
+
+    const bool named = spinner->is_named() && sleeper->is_named();
+    spinner->dec_refcount();
+    sleeper->dec_refcount();
+    if (first || !second || !named || (rates_array.size() != 2) || (sys::CThreadSampler::get_registered_number() != 0))
+        return false;
+
+    const sys::CThreadSampler::thread_rates_t& spinning = (rates_array[0].name == "ut.spinner")? rates_array[0]: rates_array[1];
+    const sys::CThreadSampler::thread_rates_t& sleeping = (rates_array[0].name == "ut.spinner")? rates_array[1]: rates_array[0];
+    for (size_t i=0; i<rates_array.size(); ++i)
+    {
+        const sys::CThreadSampler::thread_rates_t& rates = rates_array[i];
+        printf("thread %s(%u): cpu=%.1f%%, run delay=%.1f%%, voluntary=%.0f/s, involuntary=%.0f/s\n",
+               rates.name.c_str(), rates.tid, rates.cpu_percent, rates.run_delay_percent,
+               rates.voluntary_switches, rates.involuntary_switches);
+    }
+    if ((spinning.name != "ut.spinner") || (sleeping.name != "ut.sleeper.with.a.long.name")
+     || (spinning.cpu_percent < 30) || (sleeping.cpu_percent > 10) || (sleeping.voluntary_switches < 10))
+        return false;
+
+    sys::CThreadSampler::publish_metrics(rates_array);
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    return (snapshot.gauges["thread.ut.spinner.cpu_permille"] >= 300)
+        && (snapshot.gauges.count("thread.ut.sleeper.with.a.long.name.voluntary_switches_per_second") > 0);
+}
+
+int main()
+{
+    if (!test_process_info())
+        return 1;
+    if (!test_cpu_and_mem())
+        return 1;
+    if (!test_net_info())
+        return 1;
+    if (!test_sampler())
+        return 1;
+    if (!test_thread_sampler())
+        return 1;
+
+    printf("info ok\n");
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <mooon/sys/lock.h>
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/profiler.h>
+#include <mooon/sys/read_write_lock.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static mooon::sys::CLock sg_lock;
+static mooon::sys::CLock sg_unnamed_lock;
+static mooon::sys::CReadWriteLock sg_rwlock;
+
+// 在主线程持有锁时加锁，必然等待
+static void* lock_all(void* arg)
+{
+    {
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(sg_lock);
+    }
+    {
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(sg_unnamed_lock);
+    }
+    {
+        mooon::sys::WriteLockHelper lock_helper(sg_rwlock);
+    }
+    return NULL;
+}
+
+int main()
+{
+    using namespace mooon::sys;
+    sg_lock.set_contention_name("ut.lock");
+    sg_rwlock.set_contention_name("ut.rwlock");
+
+    // 未启用时不统计
+    CLockProfiler::set_sample_rate(1);
+    CLockProfiler::clear();
+    {
+        LockHelper<CLock> lock_helper(sg_lock);
+    }
+    if (CLockProfiler::to_string().find("ut.lock") != std::string::npos)
+        return 1;
+
+    CLockProfiler::enable(true);
+    for (int i=0; i<3; ++i)
+    {
+        pthread_t thread;
+        sg_lock.lock();
+        sg_unnamed_lock.lock();
+        sg_rwlock.lock_read();
+        pthread_create(&thread, NULL, lock_all, NULL);
+        usleep(10000);
+        sg_lock.unlock();
+        usleep(10000);
+        sg_unnamed_lock.unlock();
+        usleep(10000);
+        sg_rwlock.unlock();
+        pthread_join(thread, NULL);
+    }
+    CLockProfiler::enable(false);
+
+    const std::string result = CLockProfiler::to_string();
+    printf("%s", result.c_str());
+    const uint64_t contended = CMetricsRegistry::get_singleton()->get_counter("lock.ut.lock.contended")->get();
+    CHistogramSnapshot snapshot;
+    CMetricsRegistry::get_singleton()->get_histogram("lock.ut.lock.wait_ns")->get_snapshot(&snapshot);
+    if ((contended != 3) || (snapshot.get_count() != 3) || (snapshot.get_min() < 1000000))
+        return 1;
+    if ((result.find("ut.rwlock: contended=") == std::string::npos) || (result.find(" samples:\n") == std::string::npos))
+        return 1;
+
+    // 未命名的锁不统计，清除后重新开始
+    CLockProfiler::clear();
+    if (CLockProfiler::to_string().find("ut.lock: contended=0,") == std::string::npos)
+        return 1;
+
+    printf("lock profiler ok\n");
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <mooon/sys/object_pool.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#define THREAD_NUMBER 4
+#define LOOP_NUMBER   100000
+#define POOL_SIZE     8
+
+class CSession: public mooon::sys::CPoolObject
+{
+public:
+    CSession()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        _owner = -1;
+    }
+
+    int get_owner() const { return _owner; }
+    void set_owner(int owner) { _owner = owner; }
+
+private:
+    int _owner;
+};
+
+static mooon::sys::CLockFreeObjectPool<CSession> pool(true);
+static volatile int errors = 0;
+
+static void* worker(void* param)
+{
+    const int owner = static_cast<int>(reinterpret_cast<long>(param));
+
+    for (int i=0; i<LOOP_NUMBER; ++i)
+    {
+        CSession* session1 = pool.borrow();
+        CSession* session2 = pool.borrow();
+
+        // 借出的对象不能同时被其它线程持有
+        if ((session1->get_owner() != -1) || (session2->get_owner() != -1) || session1->is_in_pool())
+            __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+        session1->set_owner(owner);
+        session2->set_owner(owner);
+        if ((session1->get_owner() != owner) || (session2->get_owner() != owner))
+            __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+
+        pool.pay_back(session2);
+        pool.pay_back(session1);
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    pool.create(POOL_SIZE);
+
+    pthread_t threads[THREAD_NUMBER];
+    for (long i=0; i<THREAD_NUMBER; ++i)
+        pthread_create(&threads[i], NULL, worker, reinterpret_cast<void*>(i));
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_join(threads[i], NULL);
+
+    printf("errors: %d, avaliable: %u, borrowed: %u, high water mark: %u\n",
+        errors, pool.get_avaliable_number(), pool.get_borrowed_number(), pool.get_high_water_mark());
+    if ((errors != 0) || (pool.get_avaliable_number() != POOL_SIZE) || (pool.get_borrowed_number() != 0))
+        return 1;
+    if ((pool.get_high_water_mark() < 2) || (pool.get_high_water_mark() > 2*THREAD_NUMBER))
+        return 1;
+
+    pool.reset_high_water_mark();
+    if (pool.get_high_water_mark() != 0)
+        return 1;
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "mooon/sys/dir_utils.h"
+#include "mooon/sys/safe_logger.h"
+#include "mooon/utils/crc32.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <zlib.h>
+using namespace mooon;
+
+static const char* sg_dir = "/tmp/ut_log_archive";
+
+static void clear_dir()
+{
+    std::vector<std::string> file_names;
+    sys::CDirUtils::create_directory_recursive(sg_dir);
+    sys::CDirUtils::list(sg_dir, NULL, &file_names);
+    for (size_t i=0; i<file_names.size(); ++i)
+        unlink((std::string(sg_dir) + "/" + file_names[i]).c_str());
+}
+
+static std::vector<std::string> list_rotated(const std::string& prefix)
+{
+    std::vector<std::string> file_names;
+    std::vector<std::string> rotated_names;
+    sys::CDirUtils::list(sg_dir, NULL, &file_names);
+    for (size_t i=0; i<file_names.size(); ++i)
+    {
+        if (0 == file_names[i].compare(0, prefix.size(), prefix))
+            rotated_names.push_back(file_names[i]);
+    }
+    std::sort(rotated_names.begin(), rotated_names.end());
+    return rotated_names;
+}
+
+static std::string gunzip(const std::string& filepath)
+{
+    std::string data;
+    char buffer[4096];
+    gzFile gz = gzopen(filepath.c_str(), "rb");
+    if (NULL == gz)
+        return data;
+    for (int bytes; (bytes = gzread(gz, buffer, sizeof(buffer))) > 0;)
+        data.append(buffer, bytes);
+    gzclose(gz);
+    return data;
+}
+
+// 按大小滚动，压缩滚动出的文件，只保留备份个数
+static bool test_size()
+{
+    sys::CSafeLogger* logger = new sys::CSafeLogger(sg_dir, "size.log");
+    logger->set_single_filesize(4096);
+    logger->set_backup_number(3);
+    logger->enable_archive(sys::log_rotate_size, true, true);
+
+    struct stat st;
+    if ((0 == stat((std::string(sg_dir) + "/size.log").c_str(), &st)) && (0 == st.st_size))
+        printf("preallocated: %lld bytes\n", static_cast<long long>(st.st_blocks) * 512);
+    for (int i=0; i<500; ++i)
+        logger->log_info(__FILE__, __LINE__, NULL, "line %d", i);
+    delete logger; // 完成未完成的压缩
+
+    const std::vector<std::string> rotated_names = list_rotated("size.log.");
+    printf("size: %zu rotated\n", rotated_names.size());
+    if (rotated_names.size() != 3)
+        return false;
+    for (size_t i=0; i<rotated_names.size(); ++i)
+    {
+        printf("%s\n", rotated_names[i].c_str());
+        if (rotated_names[i].find(".gz") != rotated_names[i].size() - 3)
+            return false;
+    }
+
+    // 最后滚动出的文件包含较新的日志
+    const std::string data = gunzip(std::string(sg_dir) + "/" + rotated_names.back());
+    return (data.find("[INFO]") != std::string::npos) && (data.find("line 0\n") == std::string::npos);
+}
+
+// 上一天的文件在首次写日志时以上一天的日期滚动
+static bool test_daily()
+{
+    const std::string filepath = std::string(sg_dir) + "/daily.log";
+    FILE* fp = fopen(filepath.c_str(), "w");
+    fprintf(fp, "yesterday\n");
+    fclose(fp);
+
+    const time_t yesterday = time(NULL) - 86400;
+    struct utimbuf times;
+    times.actime = yesterday;
+    times.modtime = yesterday;
+    utime(filepath.c_str(), &times);
+
+    sys::CSafeLogger* logger = new sys::CSafeLogger(sg_dir, "daily.log");
+    logger->enable_archive(sys::log_rotate_daily, true);
+    logger->log_info(__FILE__, __LINE__, NULL, "today");
+    logger->log_info(__FILE__, __LINE__, NULL, "today again");
+    delete logger;
+
+    char stamp[sizeof("YYYYmmdd")];
+    struct tm result;
+    localtime_r(&yesterday, &result);
+    strftime(stamp, sizeof(stamp), "%Y%m%d", &result);
+
+    const std::vector<std::string> rotated_names = list_rotated("daily.log.");
+    if ((rotated_names.size() != 1) || (rotated_names[0] != std::string("daily.log.") + stamp + ".gz"))
+        return false;
+    printf("daily: %s\n", rotated_names[0].c_str());
+    if (gunzip(std::string(sg_dir) + "/" + rotated_names[0]) != "yesterday\n")
+        return false;
+
+    // 当天的日志不再滚动
+    struct stat st;
+    return (0 == stat(filepath.c_str(), &st)) && (st.st_size > 0);
+}
+
+// 多个进程写同一文件，每个滚动出的文件都超过单个文件大小（只被滚动一次），不丢日志
+static bool test_processes()
+{
+    const int process_number = 4;
+    const int line_number = 2000;
+    const uint32_t filesize = 8192;
+
+    // 先由父进程创建共享的滚动状态
+    delete new sys::CSafeLogger(sg_dir, "processes.log");
+    for (int i=0; i<process_number; ++i)
+    {
+        if (0 == fork())
+        {
+            sys::CSafeLogger* logger = new sys::CSafeLogger(sg_dir, "processes.log");
+            logger->set_single_filesize(filesize);
+            logger->set_backup_number(1000);
+            for (int j=0; j<line_number; ++j)
+                logger->log_info(__FILE__, __LINE__, NULL, "process %d line %d", i, j);
+            delete logger;
+            _exit(0);
+        }
+    }
+    for (int i=0; i<process_number; ++i)
+    {
+        int status = 0;
+        if ((-1 == wait(&status)) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+            return false;
+    }
+
+    int lines = 0;
+    const std::vector<std::string> names = list_rotated("processes.log");
+    for (size_t i=0; i<names.size(); ++i)
+    {
+        const std::string filepath = std::string(sg_dir) + "/" + names[i];
+        FILE* fp = fopen(filepath.c_str(), "r");
+        if (NULL == fp)
+            return false;
+        for (int c; (c = fgetc(fp)) != EOF;)
+        {
+            if ('\n' == c)
+                ++lines;
+        }
+        const long size = ftell(fp);
+        fclose(fp);
+        if ((names[i] != "processes.log") && (size <= static_cast<long>(filesize)))
+        {
+            printf("processes: %s %ld bytes\n", names[i].c_str(), size);
+            return false;
+        }
+    }
+
+    printf("processes: %zu files, %d lines\n", names.size(), lines);
+    return (names.size() > 10) && (process_number*line_number == lines);
+}
+
+// 创建者初始化到一半就退出了，留下未设置magic的共享内存，后来的进程应重新初始化并使用它
+static bool test_stale_segment()
+{
+    const std::string log_path = std::string(sg_dir) + "/stale.log";
+    close(open(log_path.c_str(), O_WRONLY|O_CREAT, 0644));
+    char real_path[PATH_MAX];
+    if (NULL == realpath(log_path.c_str(), real_path))
+        return false;
+
+    char name[sizeof("/mooon_log_0123456789abcdef")];
+    const size_t length = strlen(real_path);
+    snprintf(name, sizeof(name), "/mooon_log_%08x%08x", utils::CCrc32::crc32(real_path, length), utils::CCrc32::crc32c(real_path, length));
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR|O_CREAT, 0644);
+    if ((-1 == fd) || (ftruncate(fd, 4096) != 0))
+        return false;
+
+    // 全零的共享内存相当于创建者在ftruncate之后就退出了
+    sys::CSafeLogger* logger = new sys::CSafeLogger(sg_dir, "stale.log");
+    logger->log_info(__FILE__, __LINE__, NULL, "stale segment");
+    delete logger;
+
+    uint32_t magic = 0;
+    const bool ok = (pread(fd, &magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)));
+    close(fd);
+    shm_unlink(name);
+    printf("stale segment: magic %08x\n", magic);
+    return ok && (0x4D4C5331 == magic);
+}
+
+int main()
+{
+    clear_dir();
+    if (!test_size())
+        return 1;
+    if (!test_daily())
+        return 1;
+    if (!test_processes())
+        return 1;
+    if (!test_stale_segment())
+        return 1;
+    clear_dir();
+
+    printf("log archive ok\n");
+    return 0;
+}
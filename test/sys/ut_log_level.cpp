@@ -0,0 +1,91 @@
+// 去掉DETAIL级别的日志语句
+#define MOOON_LOG_MIN_LEVEL 1
+#include <mooon/sys/log.h>
+#include <stdio.h>
+
+// 记录enabled_*的调用次数和输出的日志行数
+class CCountingLogger: public mooon::sys::ILogger
+{
+public:
+    CCountingLogger(): log_level(mooon::sys::LOG_LEVEL_INFO), enabled_number(0), line_number(0), last_module(NULL) {}
+
+    virtual int get_log_level() const { return log_level; }
+    virtual void set_log_level(mooon::sys::log_level_t level) { log_level = level; mooon::sys::publish_log_level(this); }
+
+    virtual bool enabled_detail() { ++enabled_number; return log_level <= mooon::sys::LOG_LEVEL_DETAIL; }
+    virtual bool enabled_debug() { ++enabled_number; return log_level <= mooon::sys::LOG_LEVEL_DEBUG; }
+    virtual bool enabled_info() { ++enabled_number; return log_level <= mooon::sys::LOG_LEVEL_INFO; }
+    virtual bool enabled_warn() { ++enabled_number; return log_level <= mooon::sys::LOG_LEVEL_WARN; }
+
+    virtual void log_detail(const char* filename, int lineno, const char* module_name, const char* format, ...) { ++line_number; }
+    virtual void log_debug(const char* filename, int lineno, const char* module_name, const char* format, ...) { ++line_number; }
+    virtual void log_info(const char* filename, int lineno, const char* module_name, const char* format, ...) { ++line_number; last_module = module_name; }
+    virtual void log_warn(const char* filename, int lineno, const char* module_name, const char* format, ...) { ++line_number; last_module = module_name; }
+
+    int log_level;
+    int enabled_number;
+    int line_number;
+    const char* last_module;
+};
+
+static int sg_evaluated = 0;
+
+static int evaluate()
+{
+    return ++sg_evaluated;
+}
+
+int main()
+{
+    using namespace mooon::sys;
+    CCountingLogger logger;
+    g_logger = &logger;
+
+    // 未发布时走虚函数
+    MYLOG_DEBUG("debug %d\n", evaluate());
+    MYLOG_INFO("info %d\n", evaluate());
+    if ((logger.enabled_number != 2) || (logger.line_number != 1) || (sg_evaluated != 1))
+        return 1;
+
+    // 发布后只读全局的级别字
+    publish_log_level(g_logger);
+    logger.enabled_number = 0;
+    for (int i=0; i<1000; ++i)
+        MYLOG_DEBUG("debug %d\n", evaluate());
+    MYLOG_INFO("info %d\n", evaluate());
+    if ((logger.enabled_number != 0) || (logger.line_number != 2) || (sg_evaluated != 2) || MYLOG_DEBUG_ENABLE() || !MYLOG_INFO_ENABLE())
+        return 1;
+    logger.set_log_level(LOG_LEVEL_DETAIL);
+    MYLOG_DEBUG("debug %d\n", evaluate());
+    if ((logger.line_number != 3) || (sg_evaluated != 3))
+        return 1;
+
+    // 低于编译期最低级别的语句被去掉，即使日志器打开了该级别
+    MYLOG_DETAIL("detail %d\n", evaluate());
+    if ((logger.line_number != 3) || (sg_evaluated != 3) || MYLOG_DETAIL_ENABLE())
+        return 1;
+
+    // 模块只能进一步限制
+    const log_module_t module = register_log_module("kafka");
+    if ((0 == module) || (register_log_module("kafka") != module) || (register_log_module("redis") == module))
+        return 1;
+    set_log_module_level(module, LOG_LEVEL_WARN);
+    MYLOG_MODULE_INFO(module, "info %d\n", evaluate());
+    MYLOG_MODULE_WARN(module, "warn %d\n", evaluate());
+    if ((logger.line_number != 4) || (sg_evaluated != 4) || (NULL == logger.last_module))
+        return 1;
+    printf("module: %s\n", logger.last_module);
+
+    // 换了日志器后，旧的发布无效
+    CCountingLogger other_logger;
+    g_logger = &other_logger;
+    logger.enabled_number = 0;
+    MYLOG_INFO("info\n");
+    if ((1 != other_logger.enabled_number) || (1 != other_logger.line_number))
+        return 1;
+
+    unpublish_log_level(&logger);
+    g_logger = NULL;
+    printf("log level ok\n");
+    return 0;
+}
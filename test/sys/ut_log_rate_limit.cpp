@@ -0,0 +1,152 @@
+#include <mooon/sys/log.h>
+#include <mooon/sys/simple_logger.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 记录输出的行数和“suppressed”汇总行
+class CCountingLogger: public mooon::sys::ILogger
+{
+public:
+    CCountingLogger(): line_number(0), suppressed_number(0) {}
+
+    virtual bool enabled_error() { return true; }
+    virtual void log_error(const char* filename, int lineno, const char* module_name, const char* format, ...)
+    {
+        if (strstr(format, "suppressed") != NULL)
+        {
+            va_list ap;
+            va_start(ap, format);
+            suppressed_number += va_arg(ap, unsigned int);
+            va_end(ap);
+        }
+        else
+        {
+            ++line_number;
+        }
+    }
+
+    int line_number;
+    unsigned int suppressed_number;
+};
+
+// 同一个调用点
+static void log_error_storm(int number)
+{
+    for (int i=0; i<number; ++i)
+        MYLOG_ERROR_RATELIMIT(10, "error %d\n", i);
+}
+
+static bool test_rate_limit()
+{
+    CCountingLogger logger;
+    mooon::sys::g_logger = &logger;
+
+    // 一个调用点每秒最多10行，其余的只计数
+    log_error_storm(1000);
+    if ((logger.line_number < 10) || (logger.line_number > 20) || (logger.suppressed_number != 0))
+    {
+        printf("rate limit: line_number=%d\n", logger.line_number);
+        return false;
+    }
+
+    // 令牌恢复后先报告被限制的行数
+    const int line_number = logger.line_number;
+    usleep(200000);
+    log_error_storm(1);
+    if (logger.suppressed_number != static_cast<unsigned int>(1000 - line_number))
+    {
+        printf("rate limit: suppressed_number=%u\n", logger.suppressed_number);
+        return false;
+    }
+
+    mooon::sys::g_logger = NULL;
+    return true;
+}
+
+static bool test_repeat_filter()
+{
+    using namespace mooon::sys;
+    CLogRepeatFilter filter;
+    uint32_t repeated_number = 0;
+    log_level_t repeated_level = LOG_LEVEL_DEBUG;
+
+    // 未启用时不过滤
+    if (filter.filter(LOG_LEVEL_ERROR, __FILE__, 1, "a", 1, &repeated_number, &repeated_level)
+     || filter.filter(LOG_LEVEL_ERROR, __FILE__, 1, "a", 1, &repeated_number, &repeated_level))
+        return false;
+
+    filter.enable(true);
+    if (filter.filter(LOG_LEVEL_ERROR, __FILE__, 1, "a", 1, &repeated_number, &repeated_level) || (repeated_number != 0))
+        return false;
+    for (int i=0; i<5; ++i)
+    {
+        if (!filter.filter(LOG_LEVEL_ERROR, __FILE__, 1, "a", 1, &repeated_number, &repeated_level))
+            return false;
+    }
+
+    // 内容不同的行输出，并带出之前的重复行数
+    if (filter.filter(LOG_LEVEL_ERROR, __FILE__, 1, "b", 1, &repeated_number, &repeated_level)
+     || (repeated_number != 5) || (repeated_level != LOG_LEVEL_ERROR))
+        return false;
+
+    // 同样的内容但级别不同，不算重复
+    if (filter.filter(LOG_LEVEL_WARN, __FILE__, 1, "b", 1, &repeated_number, &repeated_level) || (repeated_number != 0))
+        return false;
+    if (!filter.filter(LOG_LEVEL_WARN, __FILE__, 1, "b", 1, &repeated_number, &repeated_level))
+        return false;
+    return (1 == filter.take_repeated(&repeated_level)) && (LOG_LEVEL_WARN == repeated_level) && (0 == filter.take_repeated(&repeated_level));
+}
+
+static bool test_simple_logger()
+{
+    char log_dir[] = "/tmp/ut_log_rate_limit.XXXXXX";
+    if (NULL == mkdtemp(log_dir))
+        return false;
+
+    {
+        mooon::sys::CSimpleLogger logger(log_dir, "test.log");
+        logger.enable_repeat_filter(true);
+        for (int i=0; i<100; ++i)
+            logger.error(__FILE__, __LINE__, "same");
+        logger.error(__FILE__, __LINE__, "other");
+        for (int i=0; i<3; ++i)
+            logger.error(__FILE__, __LINE__, "last");
+    }
+
+    const std::string log_path = std::string(log_dir) + "/test.log";
+    FILE* fp = fopen(log_path.c_str(), "r");
+    if (NULL == fp)
+        return false;
+
+    int line_number = 0;
+    int summary_number = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        ++line_number;
+        if ((strstr(line, "last message repeated 99 times") != NULL) || (strstr(line, "last message repeated 2 times") != NULL))
+            ++summary_number;
+    }
+    fclose(fp);
+    unlink(log_path.c_str());
+    rmdir(log_dir);
+
+    // same、汇总、other、last、汇总
+    if ((line_number != 5) || (summary_number != 2))
+    {
+        printf("simple logger: line_number=%d, summary_number=%d\n", line_number, summary_number);
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    if (!test_rate_limit() || !test_repeat_filter() || !test_simple_logger())
+        return 1;
+
+    printf("log rate limit ok\n");
+    return 0;
+}
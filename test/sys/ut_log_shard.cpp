@@ -0,0 +1,120 @@
+#include "mooon/sys/dir_utils.h"
+#include "mooon/sys/log_shard_merger.h"
+#include "mooon/sys/safe_logger.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace mooon;
+
+static const char* sg_dir = "/tmp/ut_log_shard";
+static const int sg_thread_number = 4;
+static const int sg_line_number = 300;
+
+static void clear_dir()
+{
+    std::vector<std::string> file_names;
+    sys::CDirUtils::create_directory_recursive(sg_dir);
+    sys::CDirUtils::list(sg_dir, NULL, &file_names);
+    for (size_t i=0; i<file_names.size(); ++i)
+        unlink((std::string(sg_dir) + "/" + file_names[i]).c_str());
+}
+
+struct ThreadContext
+{
+    sys::CSafeLogger* logger;
+    int index;
+};
+
+static void* log_thread(void* param)
+{
+    ThreadContext* context = static_cast<ThreadContext*>(param);
+    for (int i=0; i<sg_line_number; ++i)
+        context->logger->log_info(__FILE__, __LINE__, NULL, "thread %d line %d", context->index, i);
+    return NULL;
+}
+
+int main()
+{
+    clear_dir();
+    sys::CSafeLogger* logger = new sys::CSafeLogger(sg_dir, "shard.log");
+    logger->set_single_filesize(4096);
+    logger->set_backup_number(1000);
+    logger->enable_shard();
+    logger->log_info(__FILE__, __LINE__, NULL, "main start");
+
+    pthread_t threads[sg_thread_number];
+    ThreadContext contexts[sg_thread_number];
+    for (int i=0; i<sg_thread_number; ++i)
+    {
+        contexts[i].logger = logger;
+        contexts[i].index = i;
+        pthread_create(&threads[i], NULL, log_thread, &contexts[i]);
+    }
+
+    // 子进程写自己的分片
+    const pid_t pid = fork();
+    if (0 == pid)
+    {
+        ThreadContext context;
+        context.logger = logger;
+        context.index = sg_thread_number;
+        log_thread(&context);
+        _exit(0);
+    }
+    for (int i=0; i<sg_thread_number; ++i)
+        pthread_join(threads[i], NULL);
+    waitpid(pid, NULL, 0);
+    logger->log_info(__FILE__, __LINE__, NULL, "main end");
+    delete logger;
+
+    try
+    {
+        sys::CLogShardMerger merger(sg_dir, "shard.log");
+        int next_line[sg_thread_number+1] = { 0 };
+        int main_number = 0;
+        int total = 0;
+        uint64_t last_timestamp = 0;
+        uint64_t timestamp;
+        std::string log_line;
+
+        printf("%zu shards\n", merger.get_shard_number());
+        if (merger.get_shard_number() != sg_thread_number + 2)
+            return 1;
+        while (merger.next(&log_line, &timestamp))
+        {
+            int index, line;
+            const std::string::size_type pos = log_line.find("thread ");
+            ++total;
+            if ((timestamp < last_timestamp) || (log_line.empty()) || (log_line[log_line.size()-1] != '\n'))
+                return 1;
+            last_timestamp = timestamp;
+
+            if (std::string::npos == pos)
+            {
+                ++main_number;
+                continue;
+            }
+            if ((2 != sscanf(log_line.c_str() + pos, "thread %d line %d", &index, &line)) || (line != next_line[index]))
+            {
+                printf("out of order: %s", log_line.c_str());
+                return 1;
+            }
+            ++next_line[index];
+        }
+
+        printf("%d lines merged\n", total);
+        if ((main_number != 2) || (total != (sg_thread_number + 1) * sg_line_number + 2))
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    clear_dir();
+    printf("log shard ok\n");
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <mooon/sys/mem_pool.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// 分配完池中所有内存，检查警戒标识和可写，再全部回收
+static int exercise(mooon::sys::CRawMemPool* mem_pool, uint32_t bucket_number)
+{
+    uint32_t i;
+    std::vector<void*> ptrs;
+    for (i=0; i<bucket_number; ++i)
+    {
+        char* ptr = static_cast<char*>(mem_pool->allocate());
+        if ((NULL == ptr) || (ptr[0] != 'm'))
+            return 1;
+        memset(ptr, 'x', mem_pool->get_bucket_size());
+        ptrs.push_back(ptr);
+    }
+
+    // 池用完且不从堆上分配
+    if ((mem_pool->allocate() != NULL) || (mem_pool->get_available_number() != 0))
+        return 1;
+
+    for (i=0; i<ptrs.size(); ++i)
+    {
+        if (!mem_pool->reclaim(ptrs[i]))
+            return 1;
+    }
+    return (mem_pool->get_available_number() == bucket_number)? 0: 1;
+}
+
+static int test_backing(const char* name, uint32_t backing, int numa_node)
+{
+    const uint32_t bucket_number = 4096;
+    mooon::sys::CRawMemPool mem_pool;
+
+    mem_pool.create(1000, bucket_number, false, 1, 'm', numa_node, backing);
+    printf("%s: backing=0x%02x\n", name, mem_pool.get_backing());
+    if (exercise(&mem_pool, bucket_number) != 0)
+    {
+        printf("%s: failed\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    using namespace mooon::sys;
+
+    if (test_backing("heap", MEM_POOL_HEAP, -1) != 0)
+        return 1;
+    if (test_backing("mmap", MEM_POOL_MMAP, -1) != 0)
+        return 1;
+    if (test_backing("thp+populate", MEM_POOL_THP|MEM_POOL_POPULATE, -1) != 0)
+        return 1;
+    if (test_backing("numa+populate", MEM_POOL_MMAP|MEM_POOL_POPULATE, 0) != 0)
+        return 1;
+
+    // 通常没有预留大页，应退回普通页，但总是mmap的
+    if (test_backing("hugetlb", MEM_POOL_HUGETLB, -1) != 0)
+        return 1;
+    {
+        CRawMemPool mem_pool;
+        mem_pool.create(100, 16, false, 1, 'm', -1, MEM_POOL_HUGETLB);
+        if (0 == (mem_pool.get_backing() & MEM_POOL_MMAP))
+            return 1;
+        if ((mem_pool.get_backing() & MEM_POOL_HUGETLB) != 0)
+            printf("huge pages reserved\n");
+
+        // 重复create先释放之前的映射
+        mem_pool.create(100, 16, false);
+        if (mem_pool.get_backing() != MEM_POOL_HEAP)
+            return 1;
+    }
+
+    CThreadMemPool thread_mem_pool;
+    thread_mem_pool.create(64, 128, true, 1, 'm', MEM_POOL_MMAP);
+    void* ptr = thread_mem_pool.allocate();
+    if (NULL == ptr)
+        return 1;
+    thread_mem_pool.reclaim(ptr);
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "mooon/sys/mem_pool.h"
+#include "mooon/sys/mem_tracker.h"
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/object_pool.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+using namespace mooon;
+
+#define THREAD_NUMBER 4
+#define LOOP_NUMBER 100000
+
+class CObject: public sys::CPoolObject
+{
+public:
+    void reset() {}
+
+private:
+    char _data[100];
+};
+
+static void* thread_proc(void* param)
+{
+    sys::CMemTracker* tracker = static_cast<sys::CMemTracker*>(param);
+    for (int i=0; i<LOOP_NUMBER; ++i)
+    {
+        tracker->allocate(16);
+        tracker->release(16);
+    }
+    return NULL;
+}
+
+static bool test_tracker()
+{
+    sys::CMemTracker* tracker = sys::CMemTracker::get_tracker("ut.basic");
+    if (tracker != sys::CMemTracker::get_tracker("ut.basic"))
+        return false;
+
+    tracker->allocate(100);
+    tracker->allocate(200);
+    tracker->release(100);
+    if ((tracker->get_bytes() != 200) || (tracker->get_peak() != 300))
+        return false;
+    tracker->release(200);
+
+    pthread_t threads[THREAD_NUMBER];
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_create(&threads[i], NULL, thread_proc, tracker);
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_join(threads[i], NULL);
+    if ((tracker->get_bytes() != 0) || (tracker->get_peak() < 300) || (tracker->get_peak() > 300 + 16*THREAD_NUMBER))
+        return false;
+
+    // 度量注册表中可以看到
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    return (snapshot.gauges.count("mem.ut.basic.bytes") == 1) && (snapshot.gauges["mem.ut.basic.peak"] == tracker->get_peak());
+}
+
+static bool test_mem_pool()
+{
+    sys::CMemTracker* tracker = sys::CMemTracker::get_tracker("ut.mem_pool");
+    sys::CRawMemPool mem_pool;
+    std::vector<void*> buckets;
+
+    mem_pool.create(63, 4, true); // 加上1字节警戒为64
+    mem_pool.set_mem_tracker(tracker);
+    for (int i=0; i<6; ++i) // 2个来自堆
+        buckets.push_back(mem_pool.allocate());
+    if (tracker->get_bytes() != 6*64)
+        return false;
+
+    // 重复回收不重复减去
+    mem_pool.reclaim(buckets[0]);
+    mem_pool.reclaim(buckets[0]);
+    for (size_t i=1; i<buckets.size(); ++i)
+        mem_pool.reclaim(buckets[i]);
+    if ((tracker->get_bytes() != 0) || (tracker->get_peak() != 6*64))
+        return false;
+
+    // destroy时减去未回收的池内存
+    (void)mem_pool.allocate();
+    mem_pool.destroy();
+    return 0 == tracker->get_bytes();
+}
+
+static bool test_object_pool()
+{
+    sys::CMemTracker* tracker = sys::CMemTracker::get_tracker("ut.object_pool");
+    sys::CRawObjectPool<CObject> object_pool(true);
+    object_pool.create(2);
+    object_pool.set_mem_tracker(tracker);
+
+    CObject* objects[3];
+    for (int i=0; i<3; ++i)
+        objects[i] = object_pool.borrow();
+    if (tracker->get_bytes() != static_cast<int64_t>(3*sizeof(CObject)))
+        return false;
+    for (int i=0; i<3; ++i)
+        object_pool.pay_back(objects[i]);
+    return 0 == tracker->get_bytes();
+}
+
+static bool test_malloc_sampling()
+{
+    sys::CMemTracker::enable_malloc_sampling();
+    sys::CMemTracker::enable_malloc_sampling(); // 只添加一次
+
+    sys::MetricsSnapshot snapshot;
+    char* memory = static_cast<char*>(malloc(64*1024*1024));
+    memory[0] = 'x';
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    free(memory);
+
+    printf("malloc: %" PRId64 ", mmap: %" PRId64 ", untracked: %" PRId64 ", tracked: %" PRId64 "\n",
+        snapshot.gauges["mem.malloc.bytes"], snapshot.gauges["mem.malloc.mmap_bytes"],
+        snapshot.gauges["mem.untracked.bytes"], sys::CMemTracker::get_tracked_bytes());
+    if (!sys::CMemTracker::sample_malloc())
+        return true;
+    return snapshot.gauges["mem.malloc.bytes"] >= 64*1024*1024;
+}
+
+int main()
+{
+    if (!test_tracker())
+    {
+        printf("test_tracker failed\n");
+        return 1;
+    }
+    if (!test_mem_pool())
+    {
+        printf("test_mem_pool failed\n");
+        return 1;
+    }
+    if (!test_object_pool())
+    {
+        printf("test_object_pool failed\n");
+        return 1;
+    }
+    if (!test_malloc_sampling())
+    {
+        printf("test_malloc_sampling failed\n");
+        return 1;
+    }
+
+    std::vector<sys::CMemTracker*> trackers;
+    sys::CMemTracker::get_trackers(&trackers);
+    for (size_t i=0; i<trackers.size(); ++i)
+        printf("%s: bytes=%" PRId64 ", peak=%" PRId64 "\n", trackers[i]->get_tag().c_str(), trackers[i]->get_bytes(), trackers[i]->get_peak());
+
+    printf("mem tracker ok\n");
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/utils.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+using namespace mooon;
+
+#define THREAD_NUMBER 8
+#define RECORD_NUMBER 1000000
+
+static bool test_buckets()
+{
+    // 桶连续且覆盖所有值，上界的相对误差不超过1/32
+    uint64_t last_upper = 0;
+    for (uint32_t index=1; index<sys::CLatencyHistogram::get_bucket_index(UINT64_MAX); ++index)
+    {
+        const uint64_t upper = sys::CLatencyHistogram::get_bucket_upper_bound(index);
+        if ((upper <= last_upper)
+         || (sys::CLatencyHistogram::get_bucket_index(upper) != index)
+         || (sys::CLatencyHistogram::get_bucket_index(last_upper+1) != index)
+         || ((upper - last_upper - 1) * 32 > upper))
+        {
+            printf("bucket %u: %" PRIu64 ", %" PRIu64 "\n", index, last_upper, upper);
+            return false;
+        }
+        last_upper = upper;
+    }
+
+    printf("max value: %" PRIu64 "\n", last_upper);
+    return true;
+}
+
+static bool close_to(uint64_t value, uint64_t expected)
+{
+    return (value >= expected) && ((value - expected) * 32 <= expected);
+}
+
+static bool test_histogram()
+{
+    sys::CLatencyHistogram histogram;
+    for (uint64_t value=1; value<=100000; ++value)
+        histogram.record(value);
+
+    sys::CHistogramSnapshot snapshot;
+    histogram.get_snapshot(&snapshot);
+    printf("count=%" PRIu64 " mean=%" PRIu64 " p50=%" PRIu64 " p99=%" PRIu64 " p999=%" PRIu64 " min=%" PRIu64 " max=%" PRIu64 "\n",
+        snapshot.get_count(), snapshot.get_mean(), snapshot.get_percentile(50), snapshot.get_percentile(99),
+        snapshot.get_percentile(99.9), snapshot.get_min(), snapshot.get_max());
+    if ((snapshot.get_count() != 100000) || (snapshot.get_mean() != 50000)
+     || (snapshot.get_min() != 1) || (snapshot.get_max() != 100000)
+     || !close_to(snapshot.get_percentile(50), 50000)
+     || !close_to(snapshot.get_percentile(99), 99000)
+     || !close_to(snapshot.get_percentile(99.9), 99900)
+     || (snapshot.get_percentile(100) != 100000) || (snapshot.get_percentile(0) != 1))
+        return false;
+
+    // 分两半记录再合并，与记录在一起的相同
+    sys::CLatencyHistogram odd, even;
+    for (uint64_t value=1; value<=100000; ++value)
+        ((value % 2)? odd: even).record(value);
+    sys::CHistogramSnapshot merged, other;
+    odd.get_snapshot(&merged, true);
+    even.get_snapshot(&other, true);
+    merged.merge(other);
+    if ((merged.get_count() != snapshot.get_count()) || (merged.get_sum() != snapshot.get_sum())
+     || (merged.get_percentile(99.9) != snapshot.get_percentile(99.9)) || (merged.get_min() != 1))
+        return false;
+
+    // 清零后为空
+    odd.get_snapshot(&other);
+    return (0 == other.get_count()) && (0 == other.get_percentile(50)) && (0 == other.get_min());
+}
+
+static void* record_proc(void* param)
+{
+    sys::CCounter* counter = sys::CMetricsRegistry::get_singleton()->get_counter("ut.counter");
+    sys::CLatencyHistogram* histogram = sys::CMetricsRegistry::get_singleton()->get_histogram("ut.latency_ns");
+    const uint64_t base = reinterpret_cast<uintptr_t>(param);
+    for (uint64_t i=0; i<RECORD_NUMBER; ++i)
+    {
+        counter->inc();
+        histogram->record(base + i % 1000);
+    }
+    return NULL;
+}
+
+static void report(const sys::MetricsSnapshot& snapshot, void* context)
+{
+    __atomic_add_fetch(static_cast<int*>(context), 1, __ATOMIC_RELAXED);
+    printf("report:\n%s", sys::CMetricsRegistry::to_string(snapshot).c_str());
+}
+
+static bool test_registry()
+{
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    if ((registry->get_counter("ut.counter") != registry->get_counter("ut.counter"))
+     || (registry->get_histogram("ut.latency_ns") == registry->get_histogram("ut.other_ns")))
+        return false;
+
+    int reported = 0;
+    registry->get_gauge("ut.gauge")->set(-5);
+    registry->start(1, report, &reported);
+
+    pthread_t threads[THREAD_NUMBER];
+    const uint64_t start = sys::CClock::get_nanoseconds();
+    for (uintptr_t i=0; i<THREAD_NUMBER; ++i)
+        pthread_create(&threads[i], NULL, record_proc, reinterpret_cast<void*>(i * 1000));
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_join(threads[i], NULL);
+    const uint64_t elapsed = sys::CClock::get_nanoseconds() - start;
+    printf("%d threads: %" PRIu64 "ns per counter and histogram update\n", THREAD_NUMBER, elapsed/(THREAD_NUMBER*RECORD_NUMBER));
+
+    sys::MetricsSnapshot snapshot;
+    registry->get_snapshot(&snapshot);
+    const sys::CHistogramSnapshot& histogram = snapshot.histograms["ut.latency_ns"];
+    if ((snapshot.counters["ut.counter"] != THREAD_NUMBER * RECORD_NUMBER)
+     || (snapshot.gauges["ut.gauge"] != -5)
+     || (histogram.get_max() != THREAD_NUMBER * 1000 - 1))
+        return false;
+
+    sleep(2);
+    registry->stop();
+    registry->get_last_snapshot(&snapshot);
+    printf("reported: %d\n", reported);
+    return (reported >= 1) && (snapshot.counters["ut.counter"] == THREAD_NUMBER * RECORD_NUMBER);
+}
+
+int main()
+{
+    try
+    {
+        if (!test_buckets())
+            return 1;
+        if (!test_histogram())
+            return 1;
+        if (!test_registry())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("metrics ok\n");
+    return 0;
+}
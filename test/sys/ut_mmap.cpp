@@ -0,0 +1,139 @@
+#include "mooon/sys/mmap.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+using namespace mooon;
+
+static const char* sg_filename = "/tmp/ut_mmap.dat";
+
+static bool write_file(const std::string& data)
+{
+    FILE* fp = fopen(sg_filename, "w");
+    if (NULL == fp)
+        return false;
+    const bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+// 从偏移处映射时，长度不超过文件尾
+static bool test_map()
+{
+    const std::string data(10000, 'x');
+    if (!write_file(data))
+        return false;
+
+    int fd = open(sg_filename, O_RDONLY);
+    sys::mmap_t* ptr = sys::CMMap::map_read(fd, 8192, 4096, 0, MAP_POPULATE);
+    const bool ok = (ptr->len == 10000-4096) && ('x' == static_cast<char*>(ptr->addr)[ptr->len-1]);
+    sys::CMMap::advise(ptr, MADV_SEQUENTIAL);
+    sys::CMMap::advise(ptr, MADV_WILLNEED, 100, 10);
+    sys::CMMap::unmap(ptr);
+    close(fd);
+    printf("map: %d\n", ok);
+    return ok;
+}
+
+// 窗口只有一页，行跨越窗口和超过窗口时都能完整读出
+static bool test_lines()
+{
+    std::vector<std::string> lines;
+    std::string data;
+    for (int i=0; i<2000; ++i)
+    {
+        std::string line(rand()%100, static_cast<char>('a'+i%26));
+        if (1000 == i)
+            line.assign(3*4096+10, 'L');
+        lines.push_back(line);
+        data += line;
+        data += '\n';
+    }
+    lines.push_back("last line"); // 没有换行符
+    data += lines.back();
+    if (!write_file(data))
+        return false;
+
+    sys::CMappedReader reader(sg_filename, 4096, sys::CMappedReader::reader_drop_behind|sys::CMappedReader::reader_hugepage);
+    const char* line;
+    size_t line_size;
+    size_t number = 0;
+    while (reader.next_line(&line, &line_size))
+    {
+        if ((number >= lines.size()) || (std::string(line, line_size) != lines[number]))
+        {
+            printf("line %zu mismatched\n", number);
+            return false;
+        }
+        ++number;
+    }
+
+    printf("lines: %zu, remap: %u\n", number, reader.get_remap_number());
+    if ((number != lines.size()) || (reader.get_offset() != data.size()) || (reader.get_remap_number() < data.size()/4096))
+        return false;
+
+    // 回到开头重读
+    reader.seek(0);
+    return reader.next_line(&line, &line_size) && (std::string(line, line_size) == lines[0]);
+}
+
+static bool test_records()
+{
+    std::string data;
+    for (int i=0; i<1000; ++i)
+        data.append(reinterpret_cast<const char*>(&i), sizeof(i)).append(96, ' ');
+    data.append(50, '#'); // 不足一条的尾部
+    if (!write_file(data))
+        return false;
+
+    sys::CMappedReader reader(sg_filename, 4096, sys::CMappedReader::reader_populate);
+    const char* record;
+    int number = 0;
+    while (reader.next_record(&record, 100))
+    {
+        if (*reinterpret_cast<const int*>(record) != number)
+            return false;
+        ++number;
+    }
+
+    printf("records: %d, remap: %u\n", number, reader.get_remap_number());
+    return 1000 == number;
+}
+
+static bool test_empty()
+{
+    if (!write_file(std::string()))
+        return false;
+
+    sys::CMappedReader reader(sg_filename);
+    const char* line;
+    size_t line_size;
+    return !reader.next_line(&line, &line_size) && !reader.next_record(&line, 1);
+}
+
+int main()
+{
+    try
+    {
+        if (!test_map())
+            return 1;
+        if (!test_lines())
+            return 1;
+        if (!test_records())
+            return 1;
+        if (!test_empty())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    unlink(sg_filename);
+    printf("mmap ok\n");
+    return 0;
+}
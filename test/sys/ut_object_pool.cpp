@@ -1,4 +1,5 @@
 #include <mooon/sys/object_pool.h>
+#include <mooon/sys/metrics.h>
 #include <stdio.h>
 #include <vector>
 
@@ -29,6 +30,75 @@ private:
     int _m;
 };
 
+// 弹性对象池：用完后按slab扩容且序号有效，窗口结束后按高水位释放空闲的slab
+static int test_elastic()
+{
+    mooon::sys::CObjectPoolPolicy policy;
+    policy.chunk_size = 4;
+    policy.max_object_number = 18; // 2+4*4
+    policy.window_milliseconds = 1000;
+    policy.name = "ut";
+
+    mooon::sys::CRawObjectPool<X> pool(true);
+    pool.create_elastic(2, policy);
+
+    std::vector<X*> vec_x;
+    for (int i=0; i<20; ++i)
+        vec_x.push_back(pool.borrow());
+    for (int i=0; i<18; ++i)
+    {
+        if (vec_x[i]->get_index() != static_cast<uint32_t>(i+1))
+        {
+            printf("elastic: object %d has index %u\n", i, vec_x[i]->get_index());
+            return 1;
+        }
+    }
+    if ((vec_x[18]->get_index() != 0) || (pool.get_pool_size() != 18) || (pool.get_chunk_number() != 4) || (pool.get_heap_number() != 2))
+    {
+        printf("elastic: pool size %u, chunks %u, heap %u\n", pool.get_pool_size(), pool.get_chunk_number(), pool.get_heap_number());
+        return 1;
+    }
+
+    // 只留3个借出的，本窗口的高水位仍为20，下个窗口才按3缩容，保留一个slab的余量
+    for (int i=3; i<20; ++i)
+        pool.pay_back(vec_x[i]);
+    vec_x.resize(3);
+    const uint64_t now = mooon::sys::CClock::get_milliseconds();
+    if ((pool.adjust(now) != 0) || (pool.get_high_water_mark() != 20))
+    {
+        printf("elastic: shrank within the window, high water mark %u\n", pool.get_high_water_mark());
+        return 1;
+    }
+    if ((pool.adjust(now + 1000) != 0) || (pool.get_chunk_number() != 4))
+    {
+        printf("elastic: shrank before the high water mark dropped\n");
+        return 1;
+    }
+    const int released = pool.adjust(now + 2000);
+    if ((released != 2) || (pool.get_chunk_number() != 2) || (pool.get_pool_size() != 10) || (pool.get_avaliable_number() != 7))
+    {
+        printf("elastic: released %d, chunks %u, pool size %u\n", released, pool.get_chunk_number(), pool.get_pool_size());
+        return 1;
+    }
+
+    // 释放的位置可再创建，序号不变
+    while (vec_x.size() < 12)
+        vec_x.push_back(pool.borrow());
+    if ((vec_x[11]->get_index() != 12) || (pool.get_chunk_number() != 3))
+    {
+        printf("elastic: regrown index %u\n", vec_x[11]->get_index());
+        return 1;
+    }
+
+    mooon::sys::MetricsSnapshot snapshot;
+    mooon::sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    printf("%s", mooon::sys::CMetricsRegistry::to_string(snapshot).c_str());
+
+    for (std::vector<X*>::size_type j=0; j<vec_x.size(); ++j)
+        pool.pay_back(vec_x[j]);
+    return (0 == pool.get_borrowed_number())? 0: 1;
+}
+
 int main()
 {
     X* x;
@@ -67,5 +137,5 @@ int main()
     x->p();
     pool.pay_back(x);
 
-    return 0;
+    return test_elastic();
 }
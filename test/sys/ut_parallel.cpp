@@ -0,0 +1,270 @@
+#include <mooon/sys/parallel.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/exception.h>
+#include <mooon/utils/string_utils.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace mooon;
+
+struct SquareBody
+{
+    std::vector<uint64_t>* values;
+
+    void operator ()(size_t begin, size_t end) const
+    {
+        for (size_t i=begin; i<end; ++i)
+            (*values)[i] = static_cast<uint64_t>(i) * i;
+    }
+};
+
+struct SumBody
+{
+    const std::vector<uint64_t>* values;
+
+    uint64_t operator ()(size_t begin, size_t end) const
+    {
+        uint64_t sum = 0;
+        for (size_t i=begin; i<end; ++i)
+            sum += (*values)[i];
+        return sum;
+    }
+};
+
+struct Add
+{
+    uint64_t operator ()(uint64_t a, uint64_t b) const { return a + b; }
+};
+
+// 结果须按块的顺序拼接
+struct ConcatBody
+{
+    std::string operator ()(int begin, int end) const
+    {
+        std::string str;
+        for (int i=begin; i<end; ++i)
+            str += static_cast<char>('a' + i % 26);
+        return str;
+    }
+};
+
+struct Concat
+{
+    std::string operator ()(const std::string& a, const std::string& b) const { return a + b; }
+};
+
+// 在工作线程中嵌套调用parallel_for
+struct NestedBody
+{
+    sys::CTaskExecutor* executor;
+    std::vector<uint64_t>* values;
+
+    void operator ()(size_t begin, size_t end) const
+    {
+        for (size_t i=begin; i<end; ++i)
+        {
+            std::vector<uint64_t> inner(1000);
+            SquareBody square = { &inner };
+            (void)sys::parallel_for(executor, size_t(0), inner.size(), square, 10);
+            (*values)[i] = inner[999];
+        }
+    }
+};
+
+struct ThrowBody
+{
+    void operator ()(int begin, int end) const
+    {
+        if ((begin <= 500) && (500 < end))
+            THROW_EXCEPTION("chunk 500 failed", EIO);
+    }
+};
+
+struct CancelBody
+{
+    sys::CCancellationToken* token;
+    uint32_t* executed;
+
+    void operator ()(int begin, int end) const
+    {
+        (void)__atomic_add_fetch(executed, 1, __ATOMIC_SEQ_CST);
+        if (0 == begin)
+            token->cancel();
+        sys::CUtils::millisleep(1);
+    }
+};
+
+struct Reader
+{
+    int next;
+    int last;
+
+    bool operator ()(int* item)
+    {
+        if (next >= last)
+            return false;
+        *item = next++;
+        return true;
+    }
+};
+
+struct Doubler
+{
+    void operator ()(int* item) const { *item *= 2; }
+};
+
+struct Writer
+{
+    std::vector<int> items;
+
+    void operator ()(const int& item) { items.push_back(item); }
+};
+
+static bool test_for_and_reduce(sys::CTaskExecutor* executor)
+{
+    std::vector<uint64_t> values(100000);
+    SquareBody square = { &values };
+    if (!sys::parallel_for(executor, size_t(0), values.size(), square))
+        return false;
+    for (size_t i=0; i<values.size(); ++i)
+    {
+        if (values[i] != static_cast<uint64_t>(i) * i)
+            return false;
+    }
+
+    SumBody sum = { &values };
+    uint64_t expected = 0;
+    for (size_t i=0; i<values.size(); ++i)
+        expected += values[i];
+    if ((sys::parallel_reduce(executor, size_t(0), values.size(), uint64_t(0), sum, Add(), 7) != expected)
+     || (sys::parallel_reduce(executor, size_t(0), values.size(), uint64_t(0), sum, Add()) != expected))
+        return false;
+
+    const std::string str = sys::parallel_reduce(executor, 0, 1000, std::string(), ConcatBody(), Concat(), 3);
+    return (1000 == str.size()) && (str == ConcatBody()(0, 1000));
+}
+
+static bool test_sort(sys::CTaskExecutor* executor)
+{
+    std::vector<uint32_t> values(200000);
+    for (size_t i=0; i<values.size(); ++i)
+        values[i] = static_cast<uint32_t>(random());
+    std::vector<uint32_t> expected = values;
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<uint32_t> sorted = values;
+    sys::parallel_sort(executor, sorted.begin(), sorted.end());
+    if (sorted != expected)
+        return false;
+
+    // 块数不是2的幂
+    sorted = values;
+    sys::parallel_sort(executor, sorted.begin(), sorted.end(), std::greater<uint32_t>(), 3000);
+    std::reverse(sorted.begin(), sorted.end());
+    return sorted == expected;
+}
+
+static bool test_nested(sys::CTaskExecutor* executor)
+{
+    std::vector<uint64_t> values(64);
+    NestedBody nested = { executor, &values };
+    if (!sys::parallel_for(executor, size_t(0), values.size(), nested, 1))
+        return false;
+    for (size_t i=0; i<values.size(); ++i)
+    {
+        if (values[i] != 999 * 999)
+            return false;
+    }
+    return true;
+}
+
+static bool test_failure(sys::CTaskExecutor* executor)
+{
+    try
+    {
+        (void)sys::parallel_for(executor, 0, 1000, ThrowBody(), 10);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        if (ex.errcode() != EIO)
+            return false;
+    }
+
+    // 取消后未开始的块不再执行
+    sys::CCancellationToken token;
+    uint32_t executed = 0;
+    CancelBody cancel = { &token, &executed };
+    if (sys::parallel_for(executor, 0, 10000, cancel, 1, &token))
+        return false;
+    printf("executed %u of 10000 chunks after cancel\n", executed);
+    return executed < 10000;
+}
+
+static bool test_pipeline(sys::CTaskExecutor* executor)
+{
+    Reader reader = { 0, 1000 };
+    Writer writer;
+    if (sys::parallel_pipeline<int>(executor, reader, Doubler(), writer, 64) != 1000)
+        return false;
+    for (int i=0; i<1000; ++i)
+    {
+        if (writer.items[i] != i * 2)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        sys::CTaskExecutor executor;
+        executor.create(4);
+
+        sys::CTaskExecutor* executors[] = { &executor, NULL };
+        for (int i=0; i<2; ++i)
+        {
+            if (!test_for_and_reduce(executors[i]))
+            {
+                printf("test for and reduce failed\n");
+                return 1;
+            }
+            if (!test_sort(executors[i]))
+            {
+                printf("test sort failed\n");
+                return 1;
+            }
+            if (!test_pipeline(executors[i]))
+            {
+                printf("test pipeline failed\n");
+                return 1;
+            }
+        }
+        if (!test_nested(&executor))
+        {
+            printf("test nested failed\n");
+            return 1;
+        }
+        if (!test_failure(&executor))
+        {
+            printf("test failure failed\n");
+            return 1;
+        }
+
+        executor.destroy();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("parallel ok\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <mooon/sys/clock.h>
+#include <mooon/sys/parker.h>
+#include <mooon/sys/pool_thread.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/thread_pool.h>
+#include <mooon/sys/utils.h>
+#include <stdio.h>
+MOOON_NAMESPACE_USE
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { printf("line %d: %s\n", __LINE__, #condition); return 1; } \
+    } while (0)
+
+static sys::CParker sg_parker;
+static volatile bool sg_parked = false;
+
+static void park_once(sys::CIdleStrategy strategy)
+{
+    sg_parked = sg_parker.park(strategy, 5000);
+}
+
+// 回一个pong后等待主线程的ping
+class CPongThread: public sys::CPoolThread
+{
+public:
+    CPongThread(): pong_number(0), ping(NULL) {}
+
+    volatile uint32_t pong_number;
+    sys::CParker* ping;
+
+private:
+    virtual void before_start()
+    {
+        set_idle_strategy(sys::CIdleStrategy(sys::idle_spin_park, 100000));
+    }
+
+    virtual void run()
+    {
+        __atomic_add_fetch(&pong_number, 1, __ATOMIC_RELEASE);
+        (void)ping->unpark();
+        do_millisleep(-1);
+    }
+};
+
+int main()
+{
+    // 先给许可，park立即返回；多次unpark只算一个
+    EXPECT(!sg_parker.unpark());
+    EXPECT(!sg_parker.unpark());
+    EXPECT(sg_parker.park(sys::CIdleStrategy(sys::idle_spin_park), 0));
+    EXPECT(!sg_parker.park(sys::CIdleStrategy(sys::idle_spin_park), 0));
+
+    // 各策略都能超时
+    const sys::CIdleStrategy strategies[] = { sys::CIdleStrategy(sys::idle_block), sys::CIdleStrategy(sys::idle_busy_spin),
+                                              sys::CIdleStrategy(sys::idle_spin_yield, 100), sys::CIdleStrategy(sys::idle_spin_park, 100, 2) };
+    for (size_t i=0; i<sizeof(strategies)/sizeof(strategies[0]); ++i)
+    {
+        const uint64_t start = sys::CClock::get_milliseconds();
+        EXPECT(!sg_parker.park(strategies[i], 20));
+        EXPECT(sys::CClock::get_milliseconds() - start >= 19);
+    }
+
+    // 对方还在自旋时唤醒没有系统调用
+    {
+        sys::CThreadEngine engine(sys::bind(&park_once, sys::CIdleStrategy(sys::idle_busy_spin)));
+        sys::CUtils::millisleep(10);
+        EXPECT(!sg_parker.unpark());
+        engine.join();
+        EXPECT(sg_parked);
+    }
+
+    // 对方已在futex上睡眠时才有
+    {
+        sg_parked = false;
+        sys::CThreadEngine engine(sys::bind(&park_once, sys::CIdleStrategy(sys::idle_block)));
+        sys::CUtils::millisleep(50);
+        EXPECT(sg_parker.unpark());
+        engine.join();
+        EXPECT(sg_parked);
+    }
+
+    // 池线程以自旋的策略和主线程往返交接
+    sys::CParker ping;
+    sys::CThreadPool<CPongThread> thread_pool;
+    thread_pool.create(1);
+    CPongThread* thread = thread_pool.get_thread(0);
+    thread->ping = &ping;
+    thread->wakeup(); // 开始运行
+
+    const uint32_t round_number = 10000;
+    const sys::CIdleStrategy strategy(sys::idle_spin_park, 100000);
+    EXPECT(ping.park(strategy, 5000));
+
+    const uint64_t start = sys::CClock::get_nanoseconds();
+    for (uint32_t i=0; i<round_number; ++i)
+    {
+        thread->wakeup();
+        EXPECT(ping.park(strategy, 5000));
+    }
+    const uint64_t nanoseconds = sys::CClock::get_nanoseconds() - start;
+    EXPECT(thread->pong_number == round_number+1);
+    printf("round trip: %" PRIu64 "ns\n", nanoseconds / round_number);
+
+    // 停止时唤醒在CParker上等待的线程
+    thread_pool.destroy();
+    printf("parker ok\n");
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "mooon/sys/perf_counter.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+static bool test_values()
+{
+    mooon::sys::perf_values_t start, stop;
+    start.available = stop.available = (1U << mooon::sys::perf_cycles) | (1U << mooon::sys::perf_context_switches);
+    start.values[mooon::sys::perf_cycles] = 100;
+    stop.values[mooon::sys::perf_cycles] = 350;
+    stop.values[mooon::sys::perf_context_switches] = 2;
+
+    mooon::sys::perf_values_t total;
+    total.add(stop.sub(start));
+    total.add(stop.sub(start));
+    if ((total.get(mooon::sys::perf_cycles) != 500) || (total.get(mooon::sys::perf_context_switches) != 4)
+     || total.has(mooon::sys::perf_instructions))
+        return false;
+
+    // 不可用的计数器不输出
+    if (total.to_json() != "{\"cycles\":500,\"context_switches\":4}")
+    {
+        printf("to_json: %s\n", total.to_json().c_str());
+        return false;
+    }
+    return (start.sub(stop).get(mooon::sys::perf_cycles) == 0) && (0 == strcmp(mooon::sys::perf_values_t::get_name(mooon::sys::perf_branch_misses), "branch_misses"));
+}
+
+// 硬件计数器在虚拟机和容器中通常不可用，此时只验证不可用的行为
+static bool test_counters()
+{
+    mooon::sys::CPerfCounters counters;
+    mooon::sys::perf_values_t values;
+    if (counters.read(&values) || (values.available != 0))
+        return false;
+
+    if (!counters.open())
+    {
+        printf("perf_event_open unavailable: %s\n", strerror(errno));
+        mooon::sys::CPerfScope scope(counters, &values);
+        return 0 == counters.get_available();
+    }
+    printf("available counters: 0x%x\n", counters.get_available());
+
+    // 访问一个大数组，区域内的计数应累加到values
+    std::vector<uint64_t> array(1024 * 1024);
+    uint64_t sum = 0;
+    for (int k=0; k<3; ++k)
+    {
+        mooon::sys::CPerfScope scope(counters, &values);
+        for (size_t i=0; i<array.size(); ++i)
+            sum += array[(i * 4099) % array.size()] + i;
+    }
+    usleep(10000);
+    mooon::sys::CPerfStopWatch stop_watch(counters);
+    usleep(10000);
+    mooon::sys::perf_values_t sleep_values;
+    stop_watch.get_elapsed(&sleep_values);
+
+    printf("scope(sum=%llu): %s\n", static_cast<unsigned long long>(sum), values.to_string().c_str());
+    printf("sleep: %s\n", sleep_values.to_string().c_str());
+    if (values.available != counters.get_available())
+        return false;
+    if (values.has(mooon::sys::perf_instructions) && (values.get(mooon::sys::perf_instructions) < 3 * array.size()))
+        return false;
+    if (sleep_values.has(mooon::sys::perf_context_switches) && (0 == sleep_values.get(mooon::sys::perf_context_switches)))
+        printf("context switches are counted in user mode only\n");
+
+    // 重复open先关闭之前的计数器
+    return counters.open() && (values.available == counters.get_available());
+}
+
+int main()
+{
+    if (!test_values() || !test_counters())
+    {
+        printf("perf counter failed\n");
+        return 1;
+    }
+
+    printf("perf counter ok\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "mooon/sys/metrics.h"
+#include "mooon/sys/prefork.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/exception.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+using namespace mooon;
+
+static sys::CPreforkSupervisor* supervisor = NULL;
+
+// 工作进程0计数后立即退出，以验证重启；工作进程1一直运行到收到SIGTERM
+class CTestWorker: public sys::IPreforkWorker
+{
+private:
+    virtual int run_worker(uint16_t worker_index)
+    {
+        cpu_set_t cpu_set;
+        if ((0 == sched_getaffinity(0, sizeof(cpu_set), &cpu_set)) && (CPU_COUNT(&cpu_set) != 1))
+            supervisor->add_counter(1); // 没有按CThreadPlacement绑定
+
+        supervisor->add_counter(0, 10);
+        if (0 == worker_index)
+            return 0;
+        while (true)
+            pause();
+        return 0;
+    }
+};
+
+static void* stop_thread(void* param)
+{
+    sys::CUtils::millisleep(500);
+    supervisor->stop();
+    return NULL;
+}
+
+int main()
+{
+    try
+    {
+        CTestWorker worker;
+        std::vector<std::string> counter_names;
+        counter_names.push_back("ut.requests");
+        counter_names.push_back("ut.unpinned");
+
+        sys::CPreforkSupervisor prefork_supervisor(&worker, 2, sys::CThreadPlacement(sys::placement_explicit, std::vector<int>(1, 0)), counter_names);
+        prefork_supervisor.set_restart_milliseconds(20, 80);
+        supervisor = &prefork_supervisor;
+
+        pthread_t thread;
+        pthread_create(&thread, NULL, stop_thread, NULL);
+        prefork_supervisor.run();
+        pthread_join(thread, NULL);
+
+        // 快速退出的工作进程0按20、40、80、80...毫秒的间隔重启
+        const uint32_t restart_number = prefork_supervisor.get_restart_number(0);
+        const uint64_t requests = prefork_supervisor.get_total_counter(0);
+        printf("worker0 restarts: %u, worker1 restarts: %u, requests: %llu\n", restart_number,
+               prefork_supervisor.get_restart_number(1), static_cast<unsigned long long>(requests));
+        if ((restart_number < 4) || (restart_number > 10) || (prefork_supervisor.get_restart_number(1) != 0))
+            return 1;
+        // 最后一次重启的可能在计数前就被停止
+        if ((requests < 10 * (restart_number + 1)) || (requests > 10 * (restart_number + 2)) || (prefork_supervisor.get_total_counter(1) != 0))
+            return 1;
+        if ((prefork_supervisor.get_worker_pid(0) != 0) || (prefork_supervisor.get_worker_pid(1) != 0))
+            return 1;
+
+        sys::MetricsSnapshot snapshot;
+        sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+        if ((static_cast<int64_t>(requests) != snapshot.gauges["prefork.ut.requests"])
+         || (10 != snapshot.gauges["prefork.worker1.ut.requests"])
+         || (0 != snapshot.gauges["prefork.workers"]))
+            return 1;
+
+        printf("prefork ok\n");
+        return 0;
+    }
+    catch (utils::CException& ex)
+    {
+        fprintf(stderr, "main exception: %s\n", ex.str().c_str());
+        return 1;
+    }
+}
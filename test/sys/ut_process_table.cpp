@@ -0,0 +1,93 @@
+#include <mooon/sys/process_table.h>
+#include <mooon/sys/utils.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// 只匹配当前进程，检查命令行过滤
+class CSelfFilter: public mooon::sys::CProcessFilter
+{
+public:
+    CSelfFilter(const std::string& parameter0)
+        : _parameter0(parameter0)
+    {
+    }
+
+    virtual bool need_cmdline() const
+    {
+        return true;
+    }
+
+    virtual bool match_cmdline(int64_t pid, const char* cmdline, size_t cmdline_length) const
+    {
+        return (strlen(cmdline) == _parameter0.size()) && (0 == memcmp(cmdline, _parameter0.data(), _parameter0.size()));
+    }
+
+private:
+    const std::string _parameter0;
+};
+
+int main(int argc, char* argv[])
+{
+    using namespace mooon::sys;
+    const int64_t self = static_cast<int64_t>(getpid());
+    const std::string self_name = CUtils::get_process_name(self);
+
+    // 全部进程，单线程和多线程的结果一致（扫描期间可能有进程退出或创建，只比较自己）
+    CProcessTable process_table;
+    int n = process_table.scan(CProcessTable::PROCESS_CMDLINE, 1);
+    int i;
+    for (i=0; i<n; ++i)
+    {
+        const process_info_t& process = process_table.get_process(i);
+        if ((process.pid > 1) && (process_table.get_process(i-1).pid >= process.pid))
+            return 1;
+        if (process.pid == self)
+            break;
+    }
+    if (i == n)
+    {
+        printf("self not found\n");
+        return 1;
+    }
+
+    const process_info_t& process = process_table.get_process(i);
+    printf("pid=%" PRId64", ppid=%" PRId64", state=%c, name=%s, threads=%d, rss=%" PRId64", processes=%d\n",
+           process.pid, process.ppid, process.state, process.name.c_str(), process.thread_number, process.rss, n);
+    if ((process.ppid != static_cast<int64_t>(getppid())) || (process.name != self_name) || (process.state != 'R') ||
+        (process.thread_number != 1) || (process.parameters.empty()) || (process.parameters[0] != argv[0]))
+        return 1;
+
+    n = process_table.scan(CProcessTable::PROCESS_STAT, 4);
+    if (n < 1)
+        return 1;
+
+    // 名字过滤
+    CProcessNameFilter name_filter(self_name);
+    if ((process_table.scan(CProcessTable::PROCESS_STAT, 0, &name_filter) < 1) || (process_table.get_process(0).name != self_name))
+        return 1;
+    if (!process_table.get_process(0).parameters.empty())
+        return 1;
+
+    CProcessNameFilter regex_filter("^ut_process_tab", true);
+    if (process_table.scan(CProcessTable::PROCESS_STAT, 2, &regex_filter) < 1)
+        return 1;
+
+    // 命令行过滤
+    CSelfFilter self_filter(argv[0]);
+    if (process_table.scan(CProcessTable::PROCESS_STAT, 1, &self_filter) < 1)
+        return 1;
+
+    // CUtils的接口基于CProcessTable
+    std::vector<int64_t> pid_array;
+    if (CUtils::get_all_pid(self_name, &pid_array) < 1)
+        return 1;
+    std::vector<std::string> parameters;
+    if ((CUtils::get_program_parameters(&parameters) != argc) || (parameters[0] != argv[0]))
+        return 1;
+    if (CUtils::get_all_pid("(", &pid_array, true) != -1)
+        return 1;
+
+    printf("ok\n");
+    return 0;
+}
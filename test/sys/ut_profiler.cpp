@@ -0,0 +1,156 @@
+#include "mooon/sys/clock.h"
+#include "mooon/sys/profiler.h"
+#include <algorithm>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+using namespace mooon;
+
+// 不内联且导出（链接时加-rdynamic），以便在折叠栈中按名字找到
+extern "C" __attribute__((noinline)) uint64_t ut_profiler_burn_cpu(uint64_t milliseconds)
+{
+    const uint64_t end = sys::CClock::get_milliseconds() + milliseconds;
+    uint64_t x = 1;
+    while (sys::CClock::get_milliseconds() < end)
+    {
+        for (int i=0; i<1000; ++i)
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    return x;
+}
+
+static bool test_profiler()
+{
+    sys::CProfiler::start(1000);
+    if (!sys::CProfiler::is_running())
+        return false;
+    (void)ut_profiler_burn_cpu(300);
+    sys::CProfiler::stop();
+
+    const std::string collapsed = sys::CProfiler::get_collapsed();
+    printf("profiler: %" PRIu64" samples, %" PRIu64" dropped\n", sys::CProfiler::get_sample_number(), sys::CProfiler::get_dropped_number());
+    printf("%.*s", static_cast<int>(std::min(collapsed.size(), static_cast<size_t>(400))), collapsed.c_str());
+
+    // 采样数大约为CPU秒数乘以频率，但受时钟中断频率限制（HZ为250时每秒最多250次）
+    if ((sys::CProfiler::get_sample_number() < 30) || (std::string::npos == collapsed.find("ut_profiler_burn_cpu")))
+        return false;
+
+    // 每行以空格和样本数结尾，根在前
+    const std::string::size_type line_end = collapsed.find('\n');
+    const std::string::size_type space = collapsed.rfind(' ', line_end);
+    if ((std::string::npos == line_end) || (std::string::npos == space) || (atoi(collapsed.c_str()+space+1) <= 0))
+        return false;
+
+    try
+    {
+        sys::CProfiler::write_collapsed("/tmp/ut_profiler.collapsed");
+        sys::CProfiler::write_collapsed("/nonexistent/ut_profiler.collapsed");
+        return false;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+    unlink("/tmp/ut_profiler.collapsed");
+
+    // 已停止后不再计数
+    const uint64_t sample_number = sys::CProfiler::get_sample_number();
+    (void)ut_profiler_burn_cpu(50);
+    return sample_number == sys::CProfiler::get_sample_number();
+}
+
+static void* trace_thread(void* param)
+{
+    for (int i=0; i<10; ++i)
+    {
+        MOOON_TRACE_SCOPE("outer");
+        {
+            MOOON_TRACE_SCOPE("inner");
+            usleep(100);
+        }
+    }
+    return param;
+}
+
+static bool test_tracer()
+{
+    {
+        MOOON_TRACE_SCOPE("disabled"); // 未启用时不记录
+    }
+
+    sys::CTracer::enable(true);
+    pthread_t threads[2];
+    for (int i=0; i<2; ++i)
+        pthread_create(&threads[i], NULL, trace_thread, NULL);
+    for (int i=0; i<2; ++i)
+        pthread_join(threads[i], NULL);
+
+    std::vector<sys::trace_span_t> spans;
+    sys::CTracer::get_spans(&spans);
+    int outer = 0, inner = 0;
+    for (std::vector<sys::trace_span_t>::size_type i=0; i<spans.size(); ++i)
+    {
+        if ((0 == strcmp(spans[i].name, "outer")) && (0 == spans[i].depth))
+            ++outer;
+        else if ((0 == strcmp(spans[i].name, "inner")) && (1 == spans[i].depth) && (spans[i].duration_ns >= 100000))
+            ++inner;
+        else
+            return false;
+        if ((i > 0) && (spans[i].start_ns < spans[i-1].start_ns))
+            return false;
+    }
+    printf("tracer: %zu spans, outer=%d, inner=%d\n", spans.size(), outer, inner);
+    if ((20 != outer) || (20 != inner))
+        return false;
+
+    sys::CTracer::write_chrome_trace("/tmp/ut_profiler.trace.json");
+    FILE* fp = fopen("/tmp/ut_profiler.trace.json", "r");
+    char head[32] = { 0 };
+    const bool ok = (fp != NULL) && (fread(head, 1, 15, fp) == 15) && (0 == strcmp(head, "{\"traceEvents\":"));
+    if (fp != NULL)
+        fclose(fp);
+    unlink("/tmp/ut_profiler.trace.json");
+    if (!ok)
+        return false;
+
+    sys::CTracer::clear();
+    sys::CTracer::get_spans(&spans);
+    if (!spans.empty())
+        return false;
+
+    // 启用和未启用时一个区间的开销
+    const int number = 1000000;
+    for (int enabled=0; enabled<2; ++enabled)
+    {
+        sys::CTracer::enable(1 == enabled);
+        const uint64_t start = sys::CClock::get_nanoseconds();
+        for (int i=0; i<number; ++i)
+        {
+            MOOON_TRACE_SCOPE("bench");
+        }
+        printf("trace scope %s: %.1fns\n", enabled? "enabled": "disabled", (sys::CClock::get_nanoseconds() - start) / static_cast<double>(number));
+    }
+    sys::CTracer::enable(false);
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_profiler())
+            return 1;
+        if (!test_tracer())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("profiler ok\n");
+    return 0;
+}
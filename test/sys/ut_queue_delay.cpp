@@ -0,0 +1,90 @@
+#include <mooon/sys/event_queue.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/array_queue.h>
+#include <stdio.h>
+MOOON_NAMESPACE_USE
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { printf("line %d: %s\n", __LINE__, #condition); return 1; } \
+    } while (0)
+
+class CCountShedder: public sys::IQueueShedder<int>
+{
+public:
+    CCountShedder(): shed_number(0), last_shed(-1) {}
+
+    virtual void on_shed(int elem, uint64_t sojourn_nanoseconds)
+    {
+        ++shed_number;
+        last_shed = elem;
+    }
+
+    int shed_number;
+    int last_shed;
+};
+
+int main()
+{
+    // 从队尾出队
+    utils::CArrayQueue<int> array_queue(3);
+    array_queue.push_back(1);
+    array_queue.push_back(2);
+    array_queue.push_back(3);
+    EXPECT((3 == array_queue.back()) && (3 == array_queue.pop_back()));
+    EXPECT((1 == array_queue.pop_front()) && (2 == array_queue.pop_back()) && array_queue.is_empty());
+    array_queue.push_back(4); // 回绕
+    EXPECT((4 == array_queue.back()) && (1 == array_queue.size()));
+
+    sys::CQueueDelayPolicy policy;
+    policy.name = "ut";
+    policy.target_milliseconds = 5;
+    policy.interval_milliseconds = 20;
+    policy.adaptive_lifo = true;
+
+    CCountShedder shedder;
+    sys::CEventQueue<utils::CArrayQueue<int> > queue(64, 0, 0);
+    queue.enable_delay_control(policy, &shedder);
+
+    // 刚开始积压，不过载，先进先出
+    for (int i=1; i<=10; ++i)
+        queue.push_back(i);
+    int elem = 0;
+    EXPECT(queue.pop_front(elem) && (1 == elem));
+    EXPECT(0 == shedder.shed_number);
+
+    // 持续积压超过interval后过载：逗留超过target的都被丢弃，新来的从队尾出队
+    sys::CUtils::millisleep(30);
+    queue.push_back(11);
+    queue.push_back(12);
+    EXPECT(queue.pop_front(elem) && (12 == elem));
+    EXPECT((9 == shedder.shed_number) && (10 == shedder.last_shed));
+    EXPECT(queue.pop_front(elem) && (11 == elem));
+    EXPECT(!queue.pop_front(elem));
+
+    // 队列空过，恢复先进先出
+    queue.push_back(13);
+    queue.push_back(14);
+    EXPECT(queue.pop_front(elem) && (13 == elem));
+    EXPECT(queue.pop_front(elem) && (14 == elem));
+
+    sys::CHistogramSnapshot snapshot;
+    queue.get_sojourn_histogram()->get_snapshot(&snapshot);
+    EXPECT(5 == snapshot.get_count());
+    EXPECT(9 == sys::CMetricsRegistry::get_singleton()->get_counter("queue.ut.shed")->get());
+
+    // 全部被丢弃时继续等待，直到超时
+    sys::CEventQueue<utils::CArrayQueue<int> > waiting_queue(8, 10, 0);
+    policy.name = "ut_waiting";
+    policy.target_milliseconds = 1;
+    policy.interval_milliseconds = 1;
+    policy.adaptive_lifo = false;
+    waiting_queue.enable_delay_control(policy, &shedder);
+    waiting_queue.push_back(100);
+    sys::CUtils::millisleep(5);
+    EXPECT(!waiting_queue.pop_front(elem));
+    EXPECT((10 == shedder.shed_number) && (100 == shedder.last_shed));
+
+    printf("queue delay ok\n");
+    return 0;
+}
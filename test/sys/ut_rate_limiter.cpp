@@ -0,0 +1,190 @@
+#include "mooon/sys/clock.h"
+#include "mooon/sys/rate_limiter.h"
+#include "mooon/sys/utils.h"
+#include "mooon/utils/exception.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+using namespace mooon;
+
+// 开始时桶是满的，取完后按速率恢复
+static bool test_token_bucket()
+{
+    sys::CTokenBucket bucket(1000, 100, "ut");
+    uint64_t wait_nanoseconds;
+    if ((100 != bucket.get_available()) || !bucket.try_acquire(100) || bucket.try_acquire(1, &wait_nanoseconds))
+        return false;
+    printf("token bucket: wait %" PRIu64"ns for 1 token\n", wait_nanoseconds);
+    if ((wait_nanoseconds == 0) || (wait_nanoseconds > 1000000))
+        return false;
+
+    sys::CUtils::millisleep(50);
+    const uint64_t available = bucket.get_available();
+    printf("token bucket: %" PRIu64" available after 50ms\n", available);
+    if ((available < 45) || (available > 70))
+        return false;
+
+    // 一次超过burst的只能透支
+    if (bucket.try_acquire(101))
+        return false;
+    const uint64_t reserved = bucket.reserve(200);
+    printf("token bucket: reserve 200 waits %" PRIu64"ms\n", reserved / 1000000);
+    if ((reserved < 120000000) || (reserved > 160000000) || (0 != bucket.get_available()))
+        return false;
+
+    sys::MetricsSnapshot snapshot;
+    sys::CMetricsRegistry::get_singleton()->get_snapshot(&snapshot);
+    return (1 == snapshot.counters["rate_limiter.ut.allowed"]) && (3 == snapshot.counters["rate_limiter.ut.throttled"]);
+}
+
+struct ThreadContext
+{
+    sys::CTokenBucket* bucket;
+    uint64_t end;
+    uint64_t allowed;
+};
+
+static void* acquire_thread(void* param)
+{
+    ThreadContext* context = static_cast<ThreadContext*>(param);
+    while (sys::CClock::get_milliseconds() < context->end)
+    {
+        if (context->bucket->try_acquire())
+            ++context->allowed;
+    }
+    return NULL;
+}
+
+// 多个线程同时取，总数不超过burst加上期间产生的令牌
+static bool test_concurrent()
+{
+    sys::CTokenBucket bucket(10000, 100);
+    const int thread_number = 4;
+    pthread_t threads[thread_number];
+    ThreadContext contexts[thread_number];
+    const uint64_t start = sys::CClock::get_milliseconds();
+
+    for (int i=0; i<thread_number; ++i)
+    {
+        contexts[i].bucket = &bucket;
+        contexts[i].end = start + 200;
+        contexts[i].allowed = 0;
+        pthread_create(&threads[i], NULL, acquire_thread, &contexts[i]);
+    }
+
+    uint64_t allowed = 0;
+    for (int i=0; i<thread_number; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        allowed += contexts[i].allowed;
+    }
+
+    const uint64_t expected = 100 + (sys::CClock::get_milliseconds() - start) * 10;
+    printf("concurrent: %" PRIu64" allowed, at most %" PRIu64"\n", allowed, expected);
+    return (allowed <= expected) && (allowed >= expected * 8 / 10);
+}
+
+// 阻塞的acquire按速率放行
+static bool test_acquire()
+{
+    sys::CTokenBucket bucket(1000, 1);
+    const uint64_t start = sys::CClock::get_milliseconds();
+    for (int i=0; i<100; ++i)
+        bucket.acquire();
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - start;
+    printf("acquire: 100 tokens in %" PRIu64"ms\n", milliseconds);
+    return (milliseconds >= 95) && (milliseconds < 200);
+}
+
+static bool test_gcra()
+{
+    sys::CGcraLimiter limiter(10, 100);
+    uint64_t wait_nanoseconds;
+    for (int i=0; i<10; ++i)
+    {
+        if (!limiter.try_acquire())
+            return false;
+    }
+    if (limiter.try_acquire(1, &wait_nanoseconds) || (0 != limiter.get_remaining()))
+        return false;
+    printf("gcra: wait %" PRIu64"us\n", wait_nanoseconds / 1000);
+    if ((wait_nanoseconds == 0) || (wait_nanoseconds > 10000000))
+        return false;
+
+    // 被拒绝的不占配额，恢复一半后可以通过一半
+    sys::CUtils::millisleep(50);
+    const uint64_t remaining = limiter.get_remaining();
+    printf("gcra: %" PRIu64" remaining after 50ms\n", remaining);
+    if ((remaining < 4) || (remaining > 7) || !limiter.try_acquire(4) || limiter.is_idle(sys::CClock::get_nanoseconds()))
+        return false;
+
+    const uint64_t start = sys::CClock::get_milliseconds();
+    for (int i=0; i<10; ++i)
+        limiter.acquire();
+    const uint64_t milliseconds = sys::CClock::get_milliseconds() - start;
+    printf("gcra: 10 acquire in %" PRIu64"ms\n", milliseconds);
+    if (milliseconds < 80)
+        return false;
+
+    try
+    {
+        limiter.acquire(11);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+    return true;
+}
+
+// 每个键独立计数，恢复满额的键被回收
+static bool test_keyed()
+{
+    sys::CKeyedRateLimiter<sys::CGcraLimiter> limiter(sys::CGcraLimiter(5, 50), 4);
+    for (int i=0; i<5; ++i)
+    {
+        if (!limiter.try_acquire("a") || !limiter.try_acquire("b"))
+            return false;
+    }
+    if (limiter.try_acquire("a") || limiter.try_acquire("b") || !limiter.try_acquire("c"))
+        return false;
+    if ((3 != limiter.size()) || (0 != limiter.expire()))
+        return false;
+
+    sys::CUtils::millisleep(60);
+    const size_t expired = limiter.expire();
+    printf("keyed: %zu expired\n", expired);
+    if ((3 != expired) || (0 != limiter.size()) || !limiter.try_acquire("a", 5))
+        return false;
+
+    sys::CKeyedRateLimiter<sys::CTokenBucket> bandwidth(sys::CTokenBucket(1000000, 65536));
+    return bandwidth.try_acquire("client1", 65536) && !bandwidth.try_acquire("client1", 65536) && bandwidth.try_acquire("client2", 65536);
+}
+
+int main()
+{
+    try
+    {
+        sys::CTokenBucket bucket(0);
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+
+    if (!test_token_bucket())
+        return 1;
+    if (!test_concurrent())
+        return 1;
+    if (!test_acquire())
+        return 1;
+    if (!test_gcra())
+        return 1;
+    if (!test_keyed())
+        return 1;
+
+    printf("rate limiter ok\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <mooon/sys/read_write_lock.h>
+#include <mooon/sys/thread_engine.h>
+#include <stdio.h>
+
+#define READER_NUMBER 4
+#define LOOP_NUMBER 100000
+
+struct Pair
+{
+    uint64_t first;
+    uint64_t second; // 总是等于first
+};
+
+static mooon::sys::CDistributedReadWriteLock sg_lock;
+static Pair sg_pair = { 0, 0 };
+static mooon::sys::CSeqData<Pair> sg_seq_pair;
+static volatile int sg_broken = 0;
+
+static void reader()
+{
+    for (int i=0; i<LOOP_NUMBER; ++i)
+    {
+        {
+            mooon::sys::ReadLockHelper read_lock(sg_lock);
+            if (sg_pair.first != sg_pair.second)
+                __atomic_add_fetch(&sg_broken, 1, __ATOMIC_SEQ_CST);
+        }
+
+        const Pair pair = sg_seq_pair.get();
+        if (pair.first != pair.second)
+            __atomic_add_fetch(&sg_broken, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void writer()
+{
+    for (int i=0; i<LOOP_NUMBER/10; ++i)
+    {
+        {
+            mooon::sys::WriteLockHelper write_lock(sg_lock);
+            ++sg_pair.first;
+            ++sg_pair.second;
+        }
+
+        Pair pair = { static_cast<uint64_t>(i), static_cast<uint64_t>(i) };
+        sg_seq_pair.set(pair);
+    }
+}
+
+int main()
+{
+    printf("slot number: %u\n", sg_lock.get_slot_number());
+
+    // 读锁之间不互斥，读锁和写锁互斥
+    if (!sg_lock.try_lock_read() || !sg_lock.try_lock_read())
+        return 1;
+    if (sg_lock.try_lock_write())
+        return 1;
+    sg_lock.unlock_read();
+    sg_lock.unlock_read();
+    if (!sg_lock.try_lock_write() || sg_lock.try_lock_read() || sg_lock.try_lock_write())
+        return 1;
+    sg_lock.unlock_write();
+
+    // 槽数向上取为2的幂
+    mooon::sys::CDistributedReadWriteLock lock(5);
+    if (lock.get_slot_number() != 8)
+        return 1;
+
+    // 原有的CReadWriteLock仍可使用同样的帮助类
+    mooon::sys::CReadWriteLock read_write_lock;
+    {
+        mooon::sys::ReadLockHelper read_lock(read_write_lock);
+    }
+    {
+        mooon::sys::WriteLockHelper write_lock(read_write_lock);
+    }
+
+    mooon::sys::CThreadEngine* engines[READER_NUMBER+1];
+    for (int i=0; i<READER_NUMBER; ++i)
+        engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&reader));
+    engines[READER_NUMBER] = new mooon::sys::CThreadEngine(mooon::sys::bind(&writer));
+    for (int i=0; i<=READER_NUMBER; ++i)
+        delete engines[i];
+
+    printf("pair: %" PRIu64 ", broken: %d\n", sg_pair.first, sg_broken);
+    if ((sg_broken != 0) || (sg_pair.first != LOOP_NUMBER/10) || (sg_seq_pair.get().first != LOOP_NUMBER/10-1))
+        return 1;
+
+    printf("read write lock ok\n");
+    return 0;
+}
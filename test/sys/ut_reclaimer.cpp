@@ -0,0 +1,166 @@
+#include "mooon/sys/reclaimer.h"
+#include <pthread.h>
+#include <stdio.h>
+using namespace mooon;
+
+#define READER_NUMBER 4
+#define UPDATE_NUMBER 100000
+#define NODE_MAGIC    0x20181118
+
+struct Node
+{
+    Node(int v): magic(NODE_MAGIC), value(v) { __atomic_add_fetch(&live_number, 1, __ATOMIC_RELAXED); }
+    ~Node() { magic = 0; __atomic_sub_fetch(&live_number, 1, __ATOMIC_RELAXED); }
+
+    int magic;
+    int value;
+    static int live_number;
+};
+
+int Node::live_number = 0;
+
+static Node* sg_head = NULL;
+static volatile bool sg_stop = false;
+static int sg_errors = 0;
+
+static void check(const Node* node, int* last_value)
+{
+    // 已被销毁的节点magic为0，值只增不减
+    if ((node->magic != NODE_MAGIC) || (node->value < *last_value))
+        __atomic_add_fetch(&sg_errors, 1, __ATOMIC_RELAXED);
+    *last_value = node->value;
+}
+
+static void* epoch_reader(void* param)
+{
+    sys::CEpochReclaimer* reclaimer = static_cast<sys::CEpochReclaimer*>(param);
+    int last_value = 0;
+    while (!sg_stop)
+    {
+        sys::CEpochGuard guard(reclaimer);
+        check(__atomic_load_n(&sg_head, __ATOMIC_ACQUIRE), &last_value);
+    }
+    return NULL;
+}
+
+// 事件循环风格：一直在临界区中，每轮宣告一次静止状态
+static void* quiescent_reader(void* param)
+{
+    sys::CEpochReclaimer* reclaimer = static_cast<sys::CEpochReclaimer*>(param);
+    int last_value = 0;
+    reclaimer->enter();
+    while (!sg_stop)
+    {
+        for (int i=0; i<10; ++i)
+            check(__atomic_load_n(&sg_head, __ATOMIC_ACQUIRE), &last_value);
+        reclaimer->quiescent();
+    }
+    reclaimer->leave();
+    return NULL;
+}
+
+static void* hazard_reader(void* param)
+{
+    sys::CHazardPointers* hazard_pointers = static_cast<sys::CHazardPointers*>(param);
+    int last_value = 0;
+    while (!sg_stop)
+    {
+        check(hazard_pointers->protect(0, &sg_head), &last_value);
+        hazard_pointers->clear(0);
+    }
+    return NULL;
+}
+
+template <class Reclaimer>
+static bool run(Reclaimer* reclaimer, void* (*reader)(void*), const char* name)
+{
+    sg_head = new Node(0);
+    sg_stop = false;
+    pthread_t readers[READER_NUMBER];
+    for (int i=0; i<READER_NUMBER; ++i)
+        pthread_create(&readers[i], NULL, reader, reclaimer);
+
+    int max_live_number = 0;
+    for (int i=1; i<=UPDATE_NUMBER; ++i)
+    {
+        Node* old = __atomic_exchange_n(&sg_head, new Node(i), __ATOMIC_ACQ_REL);
+        reclaimer->retire(old);
+        const int live_number = __atomic_load_n(&Node::live_number, __ATOMIC_RELAXED);
+        if (live_number > max_live_number)
+            max_live_number = live_number;
+    }
+
+    sg_stop = true;
+    for (int i=0; i<READER_NUMBER; ++i)
+        pthread_join(readers[i], NULL);
+    printf("%s: max live %d, live %d, errors %d\n", name, max_live_number, Node::live_number, sg_errors);
+    delete sg_head;
+    return (0 == sg_errors) && (max_live_number < UPDATE_NUMBER/10);
+}
+
+static bool test_nest()
+{
+    sys::CEpochReclaimer reclaimer(1);
+    reclaimer.enter();
+    reclaimer.enter();
+    reclaimer.leave();
+    reclaimer.retire(new Node(1));
+
+    // 本线程还在临界区中，纪元最多推进一次，不能回收
+    for (int i=0; i<3; ++i)
+        (void)reclaimer.try_reclaim();
+    if (reclaimer.get_pending_number() != 1)
+        return false;
+
+    reclaimer.leave();
+    for (int i=0; i<3; ++i)
+        (void)reclaimer.try_reclaim();
+    return 0 == reclaimer.get_pending_number();
+}
+
+static bool test_rcu()
+{
+    sys::CEpochReclaimer reclaimer;
+    sys::CRcuPointer<Node> table(&reclaimer, new Node(1));
+    {
+        sys::CEpochGuard guard(&reclaimer);
+        const Node* node = table.get();
+        table.update(new Node(2));
+        (void)reclaimer.try_reclaim();
+        (void)reclaimer.try_reclaim();
+        if ((node->magic != NODE_MAGIC) || (1 != node->value) || (2 != table.get()->value))
+            return false;
+    }
+    for (int i=0; i<3; ++i)
+        (void)reclaimer.try_reclaim();
+    return 0 == reclaimer.get_pending_number();
+}
+
+int main()
+{
+    if (!test_nest() || !test_rcu() || (Node::live_number != 0))
+    {
+        printf("nest or rcu FAILURE\n");
+        return 1;
+    }
+
+    {
+        sys::CEpochReclaimer reclaimer;
+        if (!run(&reclaimer, epoch_reader, "epoch"))
+            return 1;
+        if (!run(&reclaimer, quiescent_reader, "quiescent"))
+            return 1;
+    }
+    {
+        sys::CHazardPointers hazard_pointers;
+        if (!run(&hazard_pointers, hazard_reader, "hazard"))
+            return 1;
+    }
+
+    // 回收器析构时销毁剩余的
+    printf("live after destroying reclaimers: %d\n", Node::live_number);
+    if (Node::live_number != 0)
+        return 1;
+    printf("reclaimer ok\n");
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <mooon/sys/record_reader.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+
+// 并行读取时按块收集记录，最后按块号拼接，应和顺序读取的结果相同
+class CCollector: public mooon::sys::CRecordHandler
+{
+public:
+    CCollector(int chunk_number)
+        : _records(chunk_number)
+    {
+    }
+
+    virtual bool handle(int chunk, std::string_view record)
+    {
+        _records[chunk].push_back(std::string(record));
+        return true;
+    }
+
+    std::vector<std::string> get_records() const
+    {
+        std::vector<std::string> records;
+        for (size_t i=0; i<_records.size(); ++i)
+            records.insert(records.end(), _records[i].begin(), _records[i].end());
+        return records;
+    }
+
+private:
+    std::vector<std::vector<std::string> > _records;
+};
+
+static std::vector<std::string> read_all(mooon::sys::CRecordReader* reader)
+{
+    std::vector<std::string> records;
+    std::string_view record;
+    while (reader->next(&record))
+        records.push_back(std::string(record));
+    return records;
+}
+
+static int test_split()
+{
+    using mooon::sys::CRecordReader;
+    std::vector<std::string_view> fields;
+
+    if ((CRecordReader::split("", ',', '\0', &fields) != 0) ||
+        (CRecordReader::split("a,,b,", ',', '\0', &fields) != 4) || (fields[0] != "a") || (fields[1] != "") || (fields[2] != "b") || (fields[3] != ""))
+        return 1;
+    if ((CRecordReader::split("\"x,y\",\"say \"\"hi\"\"\",z", ',', '"', &fields) != 3) ||
+        (fields[0] != "x,y") || (fields[1] != "say \"\"hi\"\"") || (fields[2] != "z"))
+        return 1;
+    if (CRecordReader::unquote(fields[1]) != "say \"hi\"")
+        return 1;
+    if ((CRecordReader::split("\"open,", ',', '"', &fields) != 1) || (fields[0] != "open,"))
+        return 1;
+    if ((CRecordReader::split("\"\",\"a\"", ',', '"', &fields) != 2) || (fields[0] != "") || (fields[1] != "a"))
+        return 1;
+    return 0;
+}
+
+int main()
+{
+    using mooon::sys::CRecordReader;
+
+    if (test_split() != 0)
+        return 1;
+
+    // 没有引号，行尾可为\r\n，最后一行没有换行符
+    std::string expected_text;
+    std::vector<std::string> expected;
+    srandom(2024);
+    for (int i=0; i<20000; ++i)
+    {
+        std::string line = mooon::utils::CStringUtils::format_string("%d\t%s\t%d", i, std::string(random()%200, 'a'+i%26).c_str(), static_cast<int>(random()));
+        expected.push_back(line);
+        expected_text += line;
+        if (i % 3 == 0)
+            expected_text += "\r";
+        if (i != 19999)
+            expected_text += "\n";
+    }
+
+    const std::string filename = mooon::utils::CStringUtils::format_string("/tmp/ut_record_reader.%d", getpid());
+    FILE* fp = fopen(filename.c_str(), "w");
+    fwrite(expected_text.data(), 1, expected_text.size(), fp);
+    fclose(fp);
+
+    CRecordReader reader('\t');
+    reader.open(filename);
+    if ((read_all(&reader) != expected) || (reader.get_record_number() != expected.size()))
+        return 1;
+
+    reader.open(filename);
+    std::vector<std::string_view> fields;
+    if (!reader.next(&fields) || (fields.size() != 3) || (fields[0] != "0"))
+        return 1;
+
+    for (int thread_number=1; thread_number<=7; thread_number+=3)
+    {
+        CCollector collector(thread_number);
+        reader.open(filename);
+        if ((reader.parallel_read(&collector, thread_number) != expected.size()) || (collector.get_records() != expected))
+        {
+            printf("parallel_read(%d) mismatch\n", thread_number);
+            return 1;
+        }
+    }
+
+    // 以小缓冲区从fd读，缓冲区要多次扩大
+    int fd = open(filename.c_str(), O_RDONLY);
+    reader.open(fd, 16);
+    if (read_all(&reader) != expected)
+        return 1;
+    try
+    {
+        CCollector collector(1);
+        reader.parallel_read(&collector);
+        return 1;
+    }
+    catch (mooon::utils::CException&)
+    {
+    }
+    close(fd);
+    unlink(filename.c_str());
+
+    // 引号中的换行符，用很多块使切分处常落在引号中
+    std::string csv;
+    expected.clear();
+    for (int i=0; i<3000; ++i)
+    {
+        std::string record = mooon::utils::CStringUtils::format_string("%d,\"multi\nline %d\n\"\"q\"\"\",end", i, i);
+        if (i % 5 == 0)
+            record = mooon::utils::CStringUtils::format_string("%d,plain", i);
+        expected.push_back(record);
+        csv += record + "\n";
+    }
+    CRecordReader csv_reader(',', '"');
+    csv_reader.attach(csv.data(), csv.size());
+    if (read_all(&csv_reader) != expected)
+        return 1;
+    for (int thread_number=1; thread_number<=64; thread_number*=4)
+    {
+        CCollector collector(thread_number);
+        csv_reader.attach(csv.data(), csv.size());
+        if ((csv_reader.parallel_read(&collector, thread_number) != expected.size()) || (collector.get_records() != expected))
+        {
+            printf("csv parallel_read(%d) mismatch\n", thread_number);
+            return 1;
+        }
+    }
+    csv_reader.attach(csv.data(), csv.size());
+    if (!csv_reader.next(&fields) || !csv_reader.next(&fields) || (fields.size() != 3) ||
+        (CRecordReader::unquote(fields[1]) != "multi\nline 1\n\"q\"") || (fields[2] != "end"))
+        return 1;
+
+    // 空文件
+    reader.open("/dev/null");
+    if (!read_all(&reader).empty())
+        return 1;
+    reader.attach("", 0);
+    CCollector collector(1);
+    if (reader.parallel_read(&collector) != 0)
+        return 1;
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <mooon/sys/ref_countable.h>
+#include <pthread.h>
+#include <stdio.h>
+
+static int sg_destroyed = 0;
+
+template <class Base>
+class CObject: public Base
+{
+public:
+    ~CObject()
+    {
+        __atomic_add_fetch(&sg_destroyed, 1, __ATOMIC_RELAXED);
+    }
+};
+
+typedef CObject<mooon::sys::CRefCountable> CAtomicObject;
+typedef CObject<mooon::sys::CLocalRefCountable> CLocalObject;
+typedef CObject<mooon::sys::CBiasedRefCountable> CBiasedObject;
+
+// 同一线程内的增减，以及CRefPtr的复制和移动
+template <class Object>
+static int test_local(const char* name)
+{
+    sg_destroyed = 0;
+    {
+        mooon::sys::CRefPtr<Object> ptr1(new Object);
+        mooon::sys::CRefPtr<Object> ptr2 = ptr1;
+        if (ptr1->get_refcount() != 2)
+        {
+            printf("%s: copy refcount=%d\n", name, ptr1->get_refcount());
+            return 1;
+        }
+
+        mooon::sys::CRefPtr<Object> ptr3(static_cast<mooon::sys::CRefPtr<Object>&&>(ptr2));
+        if (ptr2 || (ptr3->get_refcount() != 2))
+        {
+            printf("%s: move refcount=%d\n", name, ptr3->get_refcount());
+            return 1;
+        }
+
+        ptr1.reset();
+        if ((sg_destroyed != 0) || (ptr3->get_refcount() != 1))
+            return 1;
+    }
+    if (sg_destroyed != 1)
+    {
+        printf("%s: not destroyed\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+static void* release_thread(void* param)
+{
+    // 非拥有线程释放
+    static_cast<CBiasedObject*>(param)->dec_refcount();
+    return NULL;
+}
+
+static void* hold_thread(void* param)
+{
+    CBiasedObject* object = static_cast<CBiasedObject*>(param);
+    for (int i=0; i<100000; ++i)
+    {
+        object->inc_refcount();
+        object->dec_refcount();
+    }
+    return NULL;
+}
+
+static int run_thread(void* (*routine)(void*), void* param)
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, routine, param) != 0)
+        return 1;
+    return pthread_join(thread, NULL);
+}
+
+static int test_biased()
+{
+    using namespace mooon::sys;
+    sg_destroyed = 0;
+
+    // 拥有线程增加的引用由其它线程减少，计数变成0后在merge_pending中销毁
+    CBiasedObject* object = new CBiasedObject;
+    object->inc_refcount();
+    if (run_thread(release_thread, object) != 0)
+        return 1;
+    if (sg_destroyed != 0)
+        return 1;
+    if ((CBiasedRefCount::merge_pending() != 1) || (sg_destroyed != 1))
+    {
+        printf("biased: not destroyed by merge_pending\n");
+        return 1;
+    }
+
+    // 拥有线程持有引用时，其它线程并发增减，拥有线程最后释放
+    object = new CBiasedObject;
+    object->inc_refcount();
+    pthread_t threads[4];
+    for (int i=0; i<4; ++i)
+        pthread_create(&threads[i], NULL, hold_thread, object);
+    for (int i=0; i<100000; ++i)
+    {
+        object->inc_refcount();
+        object->dec_refcount();
+    }
+    for (int i=0; i<4; ++i)
+        pthread_join(threads[i], NULL);
+    (void)CBiasedRefCount::merge_pending();
+    if (object->get_refcount() != 1)
+    {
+        printf("biased: refcount=%d\n", object->get_refcount());
+        return 1;
+    }
+    object->dec_refcount();
+    (void)CBiasedRefCount::merge_pending();
+    if (sg_destroyed != 2)
+    {
+        printf("biased: destroyed=%d\n", sg_destroyed);
+        return 1;
+    }
+
+    // 只在拥有线程中增减，偏向计数减到0时合并，计数为0立即销毁
+    object = new CBiasedObject;
+    object->inc_refcount();
+    object->inc_refcount();
+    object->dec_refcount();
+    object->dec_refcount();
+    if (sg_destroyed != 3)
+        return 1;
+    return 0;
+}
+
+int main()
+{
+    if (test_local<CAtomicObject>("atomic") != 0)
+        return 1;
+    if (test_local<CLocalObject>("local") != 0)
+        return 1;
+    if (test_local<CBiasedObject>("biased") != 0)
+        return 1;
+    if (test_biased() != 0)
+        return 1;
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <mooon/sys/resource_bundle.h>
+#include <mooon/utils/exception.h>
+#include <mooon/utils/string_utils.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int check(mooon::sys::CResourceBundle* bundle, const std::string& html, const std::string& css)
+{
+    size_t size = 0;
+    const char* data = bundle->get("html/index.html", &size);
+    if ((NULL == data) || (size != html.size()) || (memcmp(data, html.data(), size) != 0))
+    {
+        printf("index.html mismatch\n");
+        return 1;
+    }
+
+    // 压缩的资源只解压一次，之后返回同一地址
+    data = bundle->get("css/main.css", &size);
+    if ((NULL == data) || (size != css.size()) || (memcmp(data, css.data(), size) != 0))
+    {
+        printf("main.css mismatch\n");
+        return 1;
+    }
+    if (bundle->get("css/main.css", &size) != data)
+        return 1;
+
+    if ((bundle->get("empty", &size) == NULL) || (size != 0))
+        return 1;
+    if ((bundle->get("missing", &size) != NULL) || (bundle->find("html/index") != -1))
+        return 1;
+    return 0;
+}
+
+int main()
+{
+    using namespace mooon;
+
+    std::string html = "<html><body>hello</body></html>";
+    std::string css;
+    for (int i=0; i<1000; ++i)
+        css += "body { margin: 0; }\n";
+
+    sys::CResourceBundleWriter writer;
+    writer.add("html/index.html", html);
+    writer.add("css/main.css", css, utils::compression_zlib);
+    writer.add("empty", std::string(), utils::compression_zlib);
+    for (int i=0; i<100; ++i)
+        writer.add(utils::CStringUtils::any2string(i), utils::CStringUtils::any2string(i*i), utils::compression_none);
+    try
+    {
+        writer.add("empty", "again");
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+    }
+
+    // 内存中的
+    std::string data;
+    writer.write(&data);
+    sys::CResourceBundle bundle;
+    bundle.open(data.data(), data.size());
+    if ((bundle.get_entry_number() != 103) || (check(&bundle, html, css) != 0))
+        return 1;
+    if (bundle.get_entry(bundle.find("css/main.css"))->compression != utils::compression_zlib)
+        return 1;
+    if (0 == bundle.get_cached_bytes())
+        return 1;
+    for (int i=0; i<100; ++i)
+    {
+        size_t size = 0;
+        const char* value = bundle.get(utils::CStringUtils::any2string(i), &size);
+        if ((NULL == value) || (std::string(value, size) != utils::CStringUtils::any2string(i*i)))
+            return 1;
+    }
+
+    // 零拷贝：未压缩的资源指向资源包内部
+    size_t size = 0;
+    const char* html_data = bundle.get("html/index.html", &size);
+    if ((html_data < data.data()) || (html_data >= data.data()+data.size()))
+        return 1;
+
+    // 损坏的资源包
+    try
+    {
+        std::string corrupted = data;
+        corrupted[0] = 'x';
+        sys::CResourceBundle bad_bundle;
+        bad_bundle.open(corrupted.data(), corrupted.size());
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+    }
+
+    // 单独的文件，以及附加到其它文件末尾
+    const std::string bundle_filepath = "/tmp/ut_resource_bundle.bundle";
+    const std::string append_filepath = "/tmp/ut_resource_bundle.exe";
+    writer.write_file(bundle_filepath);
+    bundle.open_file(bundle_filepath);
+    if (check(&bundle, html, css) != 0)
+        return 1;
+
+    FILE* fp = fopen(append_filepath.c_str(), "w");
+    fwrite("ELF-like prefix", 1, 15, fp);
+    fclose(fp);
+    writer.append_to_file(append_filepath);
+    bundle.open_file(append_filepath);
+    if (check(&bundle, html, css) != 0)
+        return 1;
+    bundle.close();
+
+    try
+    {
+        bundle.open_self(); // 测试程序没有附加资源包
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+    }
+
+    unlink(bundle_filepath.c_str());
+    unlink(append_filepath.c_str());
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "mooon/sys/robust_mutex.h"
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace mooon;
+
+#define PROCESS_NUMBER 4
+#define INCREMENT_NUMBER 20000
+
+struct Shared
+{
+    pthread_mutex_t mutex;
+    volatile uint64_t counter;
+};
+
+static bool wait_children(int number)
+{
+    bool ok = true;
+    for (int i=0; i<number; ++i)
+    {
+        int status = 0;
+        if ((-1 == wait(&status)) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+            ok = false;
+    }
+    return ok;
+}
+
+// 多个进程在锁内累加，不丢失
+static bool test_processes(Shared* shared)
+{
+    shared->counter = 0;
+    for (int i=0; i<PROCESS_NUMBER; ++i)
+    {
+        if (0 == fork())
+        {
+            sys::CRobustMutex mutex(&shared->mutex);
+            for (int j=0; j<INCREMENT_NUMBER; ++j)
+            {
+                sys::RobustLockHelper lock_helper(mutex);
+                shared->counter = shared->counter + 1;
+            }
+            _exit(0);
+        }
+    }
+
+    const bool ok = wait_children(PROCESS_NUMBER);
+    printf("processes: %llu\n", static_cast<unsigned long long>(shared->counter));
+    return ok && (PROCESS_NUMBER*INCREMENT_NUMBER == shared->counter);
+}
+
+// 持有者未解锁就退出，下一个加锁的被告知，之后锁恢复正常
+static bool test_owner_died(Shared* shared)
+{
+    if (0 == fork())
+    {
+        sys::CRobustMutex mutex(&shared->mutex);
+        (void)mutex.lock();
+        _exit(0);
+    }
+    if (!wait_children(1))
+        return false;
+
+    sys::CRobustMutex mutex(&shared->mutex);
+    if (!mutex.lock())
+        return false;
+    mutex.unlock();
+    if (mutex.lock())
+        return false;
+    mutex.unlock();
+
+    sys::RobustLockHelper lock_helper(mutex);
+    return !lock_helper.is_owner_died();
+}
+
+int main()
+{
+    void* addr = mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == addr)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    Shared* shared = static_cast<Shared*>(addr);
+    sys::CRobustMutex::init(&shared->mutex);
+    if (!test_processes(shared))
+    {
+        printf("processes failed\n");
+        return 1;
+    }
+    if (!test_owner_died(shared))
+    {
+        printf("owner died failed\n");
+        return 1;
+    }
+    if (!test_processes(shared))
+    {
+        printf("processes after owner died failed\n");
+        return 1;
+    }
+
+    munmap(addr, sizeof(Shared));
+    printf("robust mutex ok\n");
+    return 0;
+}
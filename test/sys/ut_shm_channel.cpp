@@ -0,0 +1,181 @@
+#include "mooon/sys/fork_synchronizer.h"
+#include "mooon/sys/shm_channel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace mooon;
+
+#define PRODUCER_NUMBER 2
+#define MESSAGE_NUMBER 20000
+
+struct Message
+{
+    int producer;
+    int id;
+    char payload[200];
+};
+
+static uint32_t get_message_size(int id)
+{
+    return static_cast<uint32_t>(2*sizeof(int) + id%200);
+}
+
+// 绕环多次，消息大小不一，环尾空间不够时补齐后从环首开始
+static bool test_wrap()
+{
+    sys::CShmChannel channel;
+    if (!channel.create(NULL, 1) || (channel.get_capacity() != 4096))
+        return false;
+    if ((channel.claim(channel.get_max_message_size()+1) != NULL) || (channel.get_fd() < 0))
+        return false;
+
+    char buffer[1000];
+    for (int i=0; i<10000; ++i)
+    {
+        const uint32_t size = static_cast<uint32_t>(i % 1000);
+        memset(buffer, i%256, size);
+        if (!channel.push(buffer, size))
+            return false;
+
+        const char* data;
+        uint32_t data_size;
+        if (!channel.front(&data, &data_size) || (data_size != size) || ((size > 0) && (memcmp(data, buffer, size) != 0)))
+            return false;
+        channel.pop();
+    }
+
+    // 写满后push失败
+    int number = 0;
+    while (channel.push(buffer, 100))
+        ++number;
+    printf("wrap: full after %d messages, used %llu\n", number, static_cast<unsigned long long>(channel.get_used_bytes()));
+    // 环尾不够时的填充最多浪费一条消息的空间
+    return (number >= 4096/112-1) && (channel.get_used_bytes() > 4096-2*112) && !channel.timed_push(buffer, 100, 10);
+}
+
+// 占用后未提交的消息挡住了之后的，跳过后可以继续读
+static bool test_recover()
+{
+    sys::CShmChannel channel;
+    channel.create(NULL, 4096);
+
+    char* stalled = channel.claim(10);
+    if ((NULL == stalled) || !channel.push("next", 4))
+        return false;
+
+    const char* data;
+    uint32_t size;
+    if (channel.front(&data, &size) || channel.recover_stalled(1000))
+        return false;
+    if (!channel.recover_stalled(0) || !channel.front(&data, &size) || (size != 4) || (memcmp(data, "next", 4) != 0))
+        return false;
+
+    channel.pop();
+    return !channel.commit(stalled) && !channel.front(&data, &size) && (0 == channel.get_used_bytes());
+}
+
+static void produce(const char* name, int producer, sys::ForkSynchronizer* fork_synchronizer)
+{
+    sys::CShmChannel channel;
+    channel.open(name);
+    fork_synchronizer->notify_parent_success();
+
+    Message message;
+    message.producer = producer;
+    for (message.id=0; message.id<MESSAGE_NUMBER; ++message.id)
+    {
+        memset(message.payload, message.id%256, sizeof(message.payload));
+        if (!channel.timed_push(&message, get_message_size(message.id), 10000))
+            _exit(1);
+    }
+    _exit(0);
+}
+
+// 两个生产者进程，各自的消息按序到达
+static bool test_processes()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/ut_shm_channel_%d", static_cast<int>(getpid()));
+
+    sys::CShmChannel channel;
+    if (!channel.create(name, 16384))
+        return false;
+
+    pid_t pids[PRODUCER_NUMBER];
+    for (int i=0; i<PRODUCER_NUMBER; ++i)
+    {
+        sys::ForkSynchronizer fork_synchronizer;
+        pids[i] = fork();
+        if (0 == pids[i])
+            produce(name, i, &fork_synchronizer);
+        if (fork_synchronizer.timed_wait_child_process_notification(pids[i], 5000) != 0)
+            return false;
+    }
+
+    int next_ids[PRODUCER_NUMBER] = { 0 };
+    int received = 0;
+    int waits = 0;
+    while (received < PRODUCER_NUMBER*MESSAGE_NUMBER)
+    {
+        const char* data;
+        uint32_t size;
+        if (!channel.front(&data, &size))
+        {
+            ++waits;
+            if (!channel.wait(5000) && !channel.front(&data, &size))
+                break;
+            continue;
+        }
+
+        const Message* message = reinterpret_cast<const Message*>(data);
+        if ((message->producer < 0) || (message->producer >= PRODUCER_NUMBER)
+         || (message->id != next_ids[message->producer])
+         || (size != get_message_size(message->id))
+         || ((size > 2*sizeof(int)) && (static_cast<unsigned char>(message->payload[size-2*sizeof(int)-1]) != message->id%256)))
+        {
+            printf("unexpected message: producer=%d, id=%d, size=%u\n", message->producer, message->id, size);
+            return false;
+        }
+        ++next_ids[message->producer];
+        ++received;
+        channel.pop();
+    }
+
+    bool ok = PRODUCER_NUMBER*MESSAGE_NUMBER == received;
+    for (int i=0; i<PRODUCER_NUMBER; ++i)
+    {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        ok = ok && WIFEXITED(status) && (0 == WEXITSTATUS(status));
+    }
+    printf("processes: received %d, waits %d\n", received, waits);
+
+    // 重启后再create，使用已存在的
+    sys::CShmChannel restarted;
+    ok = ok && !restarted.create(name, 16384) && (restarted.get_capacity() == 16384) && (0 == restarted.get_used_bytes());
+    sys::CShmChannel::remove(name);
+    return ok;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_wrap())
+            return 1;
+        if (!test_recover())
+            return 1;
+        if (!test_processes())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    printf("shm channel ok\n");
+    return 0;
+}
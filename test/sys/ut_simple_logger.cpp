@@ -0,0 +1,110 @@
+#include <mooon/sys/simple_logger.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static off_t file_size(const std::string& path)
+{
+    struct stat st;
+    return (0 == stat(path.c_str(), &st))? st.st_size: -1;
+}
+
+static std::string read_last_line(const std::string& path)
+{
+    std::string last_line;
+    char line[1024];
+    FILE* fp = fopen(path.c_str(), "r");
+    if (NULL == fp)
+        return last_line;
+    while (fgets(line, sizeof(line), fp) != NULL)
+        last_line = line;
+    fclose(fp);
+    return last_line;
+}
+
+static bool test_write_buffer(const std::string& log_dir)
+{
+    const std::string log_path = log_dir + "/buffered.log";
+    {
+        mooon::sys::CSimpleLogger logger(log_dir, "buffered.log");
+        logger.set_write_buffer(65536, 3600);
+
+        // 缓冲区未满，不写文件
+        for (int i=0; i<100; ++i)
+            logger.info(__FILE__, __LINE__, "item %d", i);
+        if (file_size(log_path) != 0)
+        {
+            printf("buffered: size=%d\n", static_cast<int>(file_size(log_path)));
+            return false;
+        }
+
+        // ERROR总是刷新
+        logger.error(__FILE__, __LINE__, "error");
+        if (file_size(log_path) <= 0)
+            return false;
+
+        const off_t size = file_size(log_path);
+        logger.info(__FILE__, __LINE__, "last");
+        if (file_size(log_path) != size)
+            return false;
+    }
+
+    // 析构时刷新
+    FILE* fp = fopen(log_path.c_str(), "r");
+    if (NULL == fp)
+        return false;
+    int line_number = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL)
+        ++line_number;
+    fclose(fp);
+    unlink(log_path.c_str());
+    return 102 == line_number;
+}
+
+static bool test_rotate(const std::string& log_dir, uint32_t buffer_size)
+{
+    const std::string log_path = log_dir + "/rotate.log";
+    {
+        mooon::sys::CSimpleLogger logger(log_dir, "rotate.log", 4096, 3);
+        logger.set_write_buffer(buffer_size);
+        for (int i=0; i<1000; ++i)
+            logger.info(__FILE__, __LINE__, "%d ==> abcdefghijklmnopqrestuvwxyz", i);
+    }
+
+    // 以缓存的大小判断，滚动的文件略大于log_size，但不超过一个缓冲区
+    const off_t size = file_size(log_path + ".1");
+    bool ok = (size > 4096) && (size <= 4096 + static_cast<off_t>(buffer_size) + 1024);
+    if (!ok)
+        printf("rotate: buffer_size=%u, size=%d\n", buffer_size, static_cast<int>(size));
+
+    // 析构时刷新的最后几行在当前文件中，析构前刚好滚动时当前文件为空，则在最新的备份中
+    const std::string last_path = (file_size(log_path) > 0)? log_path: log_path + ".1";
+    const std::string last_line = read_last_line(last_path);
+    if (ok && (last_line.find("999 ==> ") == std::string::npos))
+    {
+        printf("rotate: buffer_size=%u, last line of %s: %s\n", buffer_size, last_path.c_str(), last_line.c_str());
+        ok = false;
+    }
+    unlink(log_path.c_str());
+    unlink((log_path + ".1").c_str());
+    unlink((log_path + ".2").c_str());
+    unlink((log_dir + "/.rotate.log.lock").c_str());
+    return ok;
+}
+
+int main()
+{
+    char log_dir[] = "/tmp/ut_simple_logger.XXXXXX";
+    if (NULL == mkdtemp(log_dir))
+        return 1;
+
+    const bool ok = test_write_buffer(log_dir) && test_rotate(log_dir, 0) && test_rotate(log_dir, 1024);
+    rmdir(log_dir);
+    if (!ok)
+        return 1;
+
+    printf("simple logger ok\n");
+    return 0;
+}
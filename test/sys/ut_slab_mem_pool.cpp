@@ -0,0 +1,74 @@
+#include <mooon/sys/slab_mem_pool.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+int main()
+{
+    uint32_t i;
+    mooon::sys::CSlabMemPool slab_mem_pool;
+
+    // 级别为16,32,64,...,1024
+    slab_mem_pool.create(16, 1024, 100, 4, true);
+    printf("class number: %u\n", slab_mem_pool.get_class_number());
+    if (slab_mem_pool.get_class_number() != 7)
+        return 1;
+
+    for (i=0; i<slab_mem_pool.get_class_number(); ++i)
+    {
+        mooon::sys::slab_class_stat_t stat = slab_mem_pool.get_class_stat(i);
+        printf("class[%u]: %u\n", i, stat.class_size);
+    }
+
+    // 6个20字节的，落在32字节级别，其中2个来自堆
+    std::vector<void*> ptrs;
+    for (i=0; i<6; ++i)
+    {
+        void* ptr = slab_mem_pool.allocate(20);
+        memset(ptr, 'x', 20);
+        ptrs.push_back(ptr);
+    }
+
+    mooon::sys::slab_class_stat_t stat = slab_mem_pool.get_class_stat(1);
+    printf("used: %u, heap: %u, occupancy: %.3f, fragmentation: %.3f\n",
+        stat.used_number, stat.heap_number, slab_mem_pool.get_occupancy(), slab_mem_pool.get_fragmentation());
+    if ((stat.used_number != 6) || (stat.heap_number != 2))
+        return 1;
+
+    // 超过最大级别的直接从堆上分配
+    void* large = slab_mem_pool.allocate(2048);
+    if (slab_mem_pool.get_large_number() != 1)
+        return 1;
+    slab_mem_pool.reclaim(large, 2048);
+
+    for (i=0; i<ptrs.size(); ++i)
+        slab_mem_pool.reclaim(ptrs[i], 20);
+
+    stat = slab_mem_pool.get_class_stat(1);
+    if ((stat.used_number != 0) || (stat.heap_number != 0) || (stat.requested_bytes != 0) || (slab_mem_pool.get_large_number() != 0))
+        return 1;
+
+    mooon::sys::CArena arena(mooon::SIZE_1K);
+    for (i=0; i<100; ++i)
+    {
+        char* str = arena.strdup("hello", 5);
+        if (strcmp(str, "hello") != 0)
+            return 1;
+
+        void* ptr = arena.allocate(24, 8);
+        if (reinterpret_cast<uintptr_t>(ptr) % 8 != 0)
+            return 1;
+    }
+    arena.allocate(mooon::SIZE_4K);
+    printf("arena allocated: %zu, reserved: %zu, blocks: %zu\n",
+        arena.get_allocated_bytes(), arena.get_reserved_bytes(), arena.get_block_number());
+
+    arena.reset();
+    printf("after reset, allocated: %zu, reserved: %zu, blocks: %zu\n",
+        arena.get_allocated_bytes(), arena.get_reserved_bytes(), arena.get_block_number());
+    if ((arena.get_allocated_bytes() != 0) || (arena.get_block_number() != 1))
+        return 1;
+
+    printf("ok\n");
+    return 0;
+}
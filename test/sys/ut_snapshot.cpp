@@ -0,0 +1,208 @@
+#include <mooon/sys/cache.h>
+#include <mooon/sys/snapshot.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+using namespace mooon;
+
+typedef sys::CConcurrentCache<std::string, std::string> StringCache;
+typedef sys::CCacheSnapshot<std::string, std::string> StringCacheSnapshot;
+
+static const char* sg_filepath = "/tmp/ut_snapshot.snapshot";
+
+// 一个整数计数器组件
+class CCounter: public sys::ISnapshotable
+{
+public:
+    CCounter(uint64_t value): _value(value) {}
+    uint64_t get_value() const { return _value; }
+
+private:
+    virtual void save_snapshot(sys::CSnapshotWriter* writer)
+    {
+        writer->write_uint64(_value);
+    }
+
+    virtual bool load_snapshot(sys::CSnapshotReader* reader)
+    {
+        return reader->read_uint64(&_value);
+    }
+
+private:
+    uint64_t _value;
+};
+
+static sys::cache_policy_t make_policy(uint32_t capacity)
+{
+    sys::cache_policy_t policy;
+    policy.capacity = capacity;
+    policy.shard_number = 1;
+    return policy;
+}
+
+// 经memfd传递，恢复后的LRU顺序与保存时的相同
+static bool test_memfd()
+{
+    StringCache old_cache(make_policy(100));
+    StringCacheSnapshot old_cache_snapshot(&old_cache);
+    for (int i=0; i<100; ++i)
+        old_cache.put(utils::CStringUtils::int_tostring(i), utils::CStringUtils::format_string("value:%d", i));
+    std::string value;
+    (void)old_cache.get("0", &value); // 0变为最近访问的，1为最久未访问的
+
+    sys::CSnapshotManager old_manager;
+    old_manager.register_component("cache", &old_cache_snapshot);
+    const int fd = old_manager.save_to_memfd();
+
+    sys::CSnapshotManager new_manager;
+    StringCache new_cache(make_policy(100));
+    StringCacheSnapshot new_cache_snapshot(&new_cache);
+    if (!new_manager.adopt(fd) || !new_manager.register_component("cache", &new_cache_snapshot))
+        return false;
+    if ((new_cache.size() != 100) || (new_manager.release() != 0))
+        return false;
+    for (int i=0; i<100; ++i)
+    {
+        if (!new_cache.get(utils::CStringUtils::int_tostring(i), &value) || (value != utils::CStringUtils::format_string("value:%d", i)))
+        {
+            printf("key %d not restored\n", i);
+            return false;
+        }
+    }
+
+    // get改变了顺序，重新恢复一次再验证淘汰的是1
+    StringCache lru_cache(make_policy(100));
+    StringCacheSnapshot lru_cache_snapshot(&lru_cache);
+    sys::CSnapshotManager lru_manager;
+    if (!lru_manager.adopt(old_manager.save_to_memfd()) || !lru_manager.register_component("cache", &lru_cache_snapshot))
+        return false;
+    lru_cache.put("new", "new");
+    return lru_cache.get("0", &value) && !lru_cache.get("1", &value) && lru_cache.get("2", &value);
+}
+
+// 剩余的TTL扣除保存后经过的时间
+static bool test_ttl()
+{
+    StringCache old_cache(make_policy(100));
+    StringCacheSnapshot old_cache_snapshot(&old_cache);
+    old_cache.put("short", "1", 100);
+    old_cache.put("long", "2", 60000);
+    old_cache.put("forever", "3", 0);
+
+    sys::CSnapshotManager old_manager;
+    old_manager.register_component("cache", &old_cache_snapshot);
+    const int fd = old_manager.save_to_memfd();
+    sys::CUtils::millisleep(200);
+
+    StringCache new_cache(make_policy(100));
+    StringCacheSnapshot new_cache_snapshot(&new_cache);
+    sys::CSnapshotManager new_manager;
+    if (!new_manager.adopt(fd) || !new_manager.register_component("cache", &new_cache_snapshot))
+        return false;
+
+    std::string value;
+    return !new_cache.get("short", &value) && new_cache.get("long", &value) && new_cache.get("forever", &value) && (2 == new_cache.size());
+}
+
+// 经文件传递，版本不同的段被丢弃，未认领的段被统计
+static bool test_file()
+{
+    CCounter old_counter1(1), old_counter2(2), old_counter3(3);
+    sys::CSnapshotManager old_manager;
+    old_manager.register_component("counter1", &old_counter1);
+    old_manager.register_component("counter2", &old_counter2, 2);
+    old_manager.register_component("counter3", &old_counter3);
+    old_manager.save_to_file(sg_filepath);
+
+    CCounter new_counter1(0), new_counter2(0);
+    sys::CSnapshotManager new_manager;
+    if (!new_manager.adopt_file(sg_filepath) || (0 == access(sg_filepath, F_OK)))
+        return false;
+    if (!new_manager.register_component("counter1", &new_counter1) || (new_counter1.get_value() != 1))
+        return false;
+    if (new_manager.register_component("counter2", &new_counter2, 3) || (new_counter2.get_value() != 0))
+        return false;
+    if (new_manager.release() != 1)
+        return false;
+
+    // 文件已被删除，再次采用失败
+    return !new_manager.adopt_file(sg_filepath) && !new_manager.has_snapshot();
+}
+
+// 校验失败的段被丢弃，不影响其它段，头部损坏时整个快照被丢弃
+static bool test_corruption()
+{
+    CCounter old_counter1(1), old_counter2(2);
+    sys::CSnapshotManager old_manager;
+    old_manager.register_component("counter1", &old_counter1);
+    old_manager.register_component("counter2", &old_counter2);
+
+    std::string snapshot;
+    old_manager.save(&snapshot);
+    const std::string::size_type pos = snapshot.find("counter1");
+    if (std::string::npos == pos)
+        return false;
+    snapshot[pos + strlen("counter1")] ^= 0x01; // counter1的数据
+
+    const int fd = open(sg_filepath, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if ((-1 == fd) || (write(fd, snapshot.data(), snapshot.size()) != static_cast<ssize_t>(snapshot.size())))
+        return false;
+    close(fd);
+
+    CCounter new_counter1(0), new_counter2(0);
+    sys::CSnapshotManager new_manager;
+    if (!new_manager.adopt_file(sg_filepath))
+        return false;
+    if (new_manager.register_component("counter1", &new_counter1) || (new_counter1.get_value() != 0))
+        return false;
+    if (!new_manager.register_component("counter2", &new_counter2) || (new_counter2.get_value() != 2))
+        return false;
+
+    // 截断的快照
+    const int truncated_fd = open(sg_filepath, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if ((-1 == truncated_fd) || (write(truncated_fd, snapshot.data(), snapshot.size()-8) != static_cast<ssize_t>(snapshot.size()-8)))
+        return false;
+    close(truncated_fd);
+    return !new_manager.adopt_file(sg_filepath) && !new_manager.has_snapshot();
+}
+
+int main()
+{
+    try
+    {
+        if (!test_memfd())
+        {
+            printf("test memfd failed\n");
+            return 1;
+        }
+        if (!test_ttl())
+        {
+            printf("test ttl failed\n");
+            return 1;
+        }
+        if (!test_file())
+        {
+            printf("test file failed\n");
+            return 1;
+        }
+        if (!test_corruption())
+        {
+            printf("test corruption failed\n");
+            return 1;
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    (void)unlink(sg_filepath);
+    printf("snapshot ok\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <mooon/sys/object_pool.h>
+#include <mooon/sys/spin_lock.h>
+#include <mooon/sys/thread_engine.h>
+#include <stdio.h>
+
+#define THREAD_NUMBER 4
+#define LOOP_NUMBER 200000
+
+class CObject: public mooon::sys::CPoolObject
+{
+public:
+    void reset() {}
+};
+
+static uint64_t sg_counter = 0;
+
+template <class LockClass>
+static void increase(LockClass* lock)
+{
+    for (int i=0; i<LOOP_NUMBER; ++i)
+    {
+        mooon::sys::LockHelper<LockClass> lock_helper(*lock);
+        ++sg_counter; // 非原子操作，依靠锁保护
+    }
+}
+
+template <class LockClass>
+static bool test_lock(const char* name, LockClass* lock)
+{
+    sg_counter = 0;
+    mooon::sys::CThreadEngine* engines[THREAD_NUMBER];
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&increase<LockClass>, lock));
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        delete engines[i]; // 析构时join
+
+    printf("%s: counter=%" PRIu64 ", lock=%" PRIu64 ", contention=%" PRIu64 "\n",
+           name, sg_counter, lock->get_lock_number(), lock->get_contention_number());
+    if (sg_counter != THREAD_NUMBER * LOOP_NUMBER)
+        return false;
+    if (lock->get_lock_number() != THREAD_NUMBER * LOOP_NUMBER)
+        return false;
+
+    // 已被持有时try_lock失败
+    if (!lock->try_lock() || lock->try_lock())
+        return false;
+    lock->unlock();
+    return true;
+}
+
+int main()
+{
+    mooon::sys::CAdaptiveLock adaptive_lock(100, true);
+    if (!test_lock("adaptive lock", &adaptive_lock))
+        return 1;
+    printf("adaptive lock slept %" PRIu64 " times\n", adaptive_lock.get_sleep_number());
+
+    mooon::sys::CTicketLock ticket_lock(true);
+    if (!test_lock("ticket lock", &ticket_lock))
+        return 1;
+
+    // 未开启统计
+    mooon::sys::CAdaptiveLock lock;
+    lock.lock();
+    lock.unlock();
+    if (lock.get_lock_number() != 0)
+        return 1;
+
+    // 以锁类型为模板参数
+    mooon::sys::CThreadObjectPool<CObject, mooon::sys::CTicketLock> object_pool(false);
+    object_pool.create(2);
+    CObject* object = object_pool.borrow();
+    if ((NULL == object) || (object_pool.get_avaliable_number() != 1))
+        return 1;
+    object_pool.pay_back(object);
+    if (object_pool.get_avaliable_number() != 2)
+        return 1;
+    object_pool.destroy();
+
+    printf("spin lock ok\n");
+    return 0;
+}
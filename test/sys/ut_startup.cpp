@@ -0,0 +1,190 @@
+#include <mooon/sys/startup.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/exception.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string>
+using namespace mooon;
+
+// 记录任务的执行顺序
+static sys::CLock sg_lock;
+static std::string sg_order;
+
+// 任务的参数不用const char*，否则utils::bind会匹配成员函数的版本
+static bool sleep_task(std::string name, uint32_t milliseconds)
+{
+    sys::CUtils::millisleep(milliseconds);
+    sys::LockHelper<sys::CLock> lock_helper(sg_lock);
+    sg_order += name;
+    return true;
+}
+
+static bool fail_task(std::string name)
+{
+    sys::LockHelper<sys::CLock> lock_helper(sg_lock);
+    sg_order += name;
+    return false;
+}
+
+static bool throw_task(std::string errmsg)
+{
+    THROW_EXCEPTION(errmsg, EIO);
+}
+
+// 独立的任务并行执行，总耗时由最长的依赖链决定
+static bool test_parallel()
+{
+    sys::CStartupProfiler profiler;
+    sys::CParallelInitializer initializer;
+    sg_order.clear();
+    initializer.add_task("db", utils::bind<bool>(&sleep_task, std::string("d"), 300u));
+    initializer.add_task("zookeeper", utils::bind<bool>(&sleep_task, std::string("z"), 100u));
+    initializer.add_task("kafka", utils::bind<bool>(&sleep_task, std::string("k"), 100u));
+    initializer.add_task("cache", utils::bind<bool>(&sleep_task, std::string("c"), 100u), "db, zookeeper");
+
+    const uint64_t start_milliseconds = sys::CClock::get_milliseconds();
+    if (!initializer.run(0, &profiler))
+        return false;
+    const uint64_t elapsed_milliseconds = sys::CClock::get_milliseconds() - start_milliseconds;
+    printf("parallel: %" PRIu64"ms, order: %s, critical path: %s\n", elapsed_milliseconds, sg_order.c_str(), initializer.get_critical_path().c_str());
+    printf("%s\n", profiler.to_string().c_str());
+
+    // 串行需要600毫秒
+    if ((elapsed_milliseconds < 400) || (elapsed_milliseconds >= 590))
+        return false;
+    if ((sg_order[3] != 'c') || (initializer.get_critical_path() != "db -> cache"))
+        return false;
+    return 4 == profiler.get_phases().size();
+}
+
+// 只有一个线程时按依赖顺序串行执行
+static bool test_serial()
+{
+    sys::CParallelInitializer initializer;
+    sg_order.clear();
+    initializer.add_task("c", utils::bind<bool>(&sleep_task, std::string("c"), 0u), "b");
+    initializer.add_task("b", utils::bind<bool>(&sleep_task, std::string("b"), 0u), "a");
+    initializer.add_task("a", utils::bind<bool>(&sleep_task, std::string("a"), 0u));
+    return initializer.run(1) && ("abc" == sg_order);
+}
+
+// 失败后依赖它的任务不执行
+static bool test_failure()
+{
+    sys::CParallelInitializer initializer;
+    sg_order.clear();
+    initializer.add_task("db", utils::bind<bool>(&fail_task, std::string("d")));
+    initializer.add_task("cache", utils::bind<bool>(&sleep_task, std::string("c"), 0u), "db");
+    if (initializer.run() || (sg_order != "d"))
+        return false;
+    printf("%s\n", initializer.get_error().c_str());
+
+    sys::CParallelInitializer throw_initializer;
+    throw_initializer.add_task("kafka", utils::bind<bool>(&throw_task, std::string("broker down")));
+    if (throw_initializer.run(2))
+        return false;
+    printf("%s\n", throw_initializer.get_error().c_str());
+    return throw_initializer.get_error().find("broker down") != std::string::npos;
+}
+
+// 依赖不存在、循环依赖和重名时抛出异常，不执行任何任务
+static bool test_invalid()
+{
+    sg_order.clear();
+    try
+    {
+        sys::CParallelInitializer initializer;
+        initializer.add_task("cache", utils::bind<bool>(&sleep_task, std::string("c"), 0u), "db");
+        (void)initializer.run();
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+    }
+    try
+    {
+        sys::CParallelInitializer initializer;
+        initializer.add_task("a", utils::bind<bool>(&sleep_task, std::string("a"), 0u), "c");
+        initializer.add_task("b", utils::bind<bool>(&sleep_task, std::string("b"), 0u), "a");
+        initializer.add_task("c", utils::bind<bool>(&sleep_task, std::string("c"), 0u), "b");
+        initializer.add_task("d", utils::bind<bool>(&sleep_task, std::string("d"), 0u));
+        (void)initializer.run();
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+    }
+    try
+    {
+        sys::CParallelInitializer initializer;
+        initializer.add_task("a", utils::bind<bool>(&sleep_task, std::string("a"), 0u));
+        initializer.add_task("a", utils::bind<bool>(&sleep_task, std::string("a"), 0u));
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+    }
+    return sg_order.empty();
+}
+
+static bool test_profiler()
+{
+    sys::CStartupProfiler profiler;
+    {
+        sys::CStartupPhase phase(&profiler, "load_cache");
+        sys::CUtils::millisleep(20);
+    }
+    {
+        sys::CStartupPhase phase(&profiler, "parse_arguments");
+    }
+
+    const std::vector<sys::startup_phase_t> phases = profiler.get_phases();
+    printf("%s\n", profiler.to_string().c_str());
+    return (2 == phases.size()) && ("load_cache" == phases[0].name) && (phases[0].duration_milliseconds >= 20)
+        && (phases[1].start_milliseconds >= 20) && (0 == profiler.to_string().find("total "));
+}
+
+int main()
+{
+    try
+    {
+        if (!test_profiler())
+        {
+            printf("test profiler failed\n");
+            return 1;
+        }
+        if (!test_parallel())
+        {
+            printf("test parallel failed\n");
+            return 1;
+        }
+        if (!test_serial())
+        {
+            printf("test serial failed\n");
+            return 1;
+        }
+        if (!test_failure())
+        {
+            printf("test failure failed\n");
+            return 1;
+        }
+        if (!test_invalid())
+        {
+            printf("test invalid failed\n");
+            return 1;
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("startup ok\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <mooon/sys/static_hash_table.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/utils/exception.h>
+#include <mooon/utils/string_utils.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+using namespace mooon;
+
+static const char* sg_filepath = "/tmp/ut_static_hash_table.sht";
+
+static std::string make_key(int i)
+{
+    return utils::CStringUtils::format_string("key:%d", i);
+}
+
+// 值的长度在0到99之间，包括空值
+static std::string make_value(int i)
+{
+    return std::string(static_cast<size_t>(i % 100), static_cast<char>('a' + i % 26));
+}
+
+static bool check_table(const sys::CStaticHashTable& table, int key_number)
+{
+    std::string_view value;
+    for (int i=0; i<key_number; ++i)
+    {
+        if (!table.find(make_key(i), &value) || (value != make_value(i)))
+        {
+            printf("key %d not found\n", i);
+            return false;
+        }
+    }
+    for (int i=key_number; i<key_number*2; ++i)
+    {
+        if (table.find(make_key(i), &value))
+        {
+            printf("key %d found\n", i);
+            return false;
+        }
+    }
+    return !table.find("", NULL) && !table.find("key:", NULL);
+}
+
+static bool test_build(int key_number)
+{
+    sys::CStaticHashTableWriter writer;
+    for (int i=0; i<key_number; ++i)
+        writer.add(make_key(i), make_value(i));
+
+    const uint64_t start_milliseconds = sys::CClock::get_milliseconds();
+    writer.write_file(sg_filepath);
+    const uint64_t build_milliseconds = sys::CClock::get_milliseconds() - start_milliseconds;
+
+    sys::CStaticHashTable table;
+    table.open_file(sg_filepath);
+    printf("%d keys: build %" PRIu64"ms, %zu bytes\n", key_number, build_milliseconds, table.get_size());
+    if (table.get_key_number() != static_cast<uint64_t>(key_number))
+        return false;
+    if (!check_table(table, key_number))
+        return false;
+
+    // 打开时读入所有页也一样
+    sys::CStaticHashTable populated_table;
+    populated_table.open_file(sg_filepath, true);
+    return check_table(populated_table, key_number);
+}
+
+// 重新生成时，已打开的仍是旧的，重新打开得到新的
+static bool test_replace()
+{
+    sys::CStaticHashTableWriter old_writer;
+    old_writer.add("city", "shenzhen");
+    old_writer.write_file(sg_filepath);
+
+    sys::CStaticHashTable old_table;
+    old_table.open_file(sg_filepath);
+
+    sys::CStaticHashTableWriter new_writer;
+    new_writer.add("city", "guangzhou");
+    new_writer.add("country", "china");
+    new_writer.write_file(sg_filepath);
+
+    std::string_view value;
+    if (!old_table.find("city", &value) || (value != "shenzhen") || old_table.find("country", NULL))
+        return false;
+
+    sys::CStaticHashTable new_table;
+    new_table.open_file(sg_filepath);
+    return new_table.find("city", &value) && (value == "guangzhou") && new_table.find("country", NULL);
+}
+
+static bool test_duplicate()
+{
+    sys::CStaticHashTableWriter writer;
+    writer.add("a", "1");
+    writer.add("b", "2");
+    writer.add("a", "3");
+    try
+    {
+        writer.write_file(sg_filepath);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return EEXIST == ex.errcode();
+    }
+}
+
+// 截断或不是哈希表的文件打开失败
+static bool test_corruption()
+{
+    sys::CStaticHashTableWriter writer;
+    for (int i=0; i<1000; ++i)
+        writer.add(make_key(i), make_value(i));
+    writer.write_file(sg_filepath);
+    if (-1 == truncate(sg_filepath, 1000))
+        return false;
+
+    sys::CStaticHashTable table;
+    try
+    {
+        table.open_file(sg_filepath);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+    }
+
+    try
+    {
+        table.open_file("/proc/self/exe");
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+    }
+    return !table.is_open();
+}
+
+int main()
+{
+    try
+    {
+        if (!test_build(0) || !test_build(1) || !test_build(10) || !test_build(200000))
+            return 1;
+        if (!test_replace())
+            return 1;
+        if (!test_duplicate())
+            return 1;
+        if (!test_corruption())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    (void)unlink(sg_filepath);
+    printf("static hash table ok\n");
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/string_interner.h>
+#include <mooon/utils/exception.h>
+#include <mooon/utils/string_utils.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+using namespace mooon;
+
+#define THREAD_NUMBER 8
+#define STRING_NUMBER 10000
+
+static sys::CStringInterner* sg_interner = NULL;
+static sys::CInternedString sg_interned[THREAD_NUMBER][STRING_NUMBER];
+
+// 各线程以不同的顺序驻留同一组字符串
+static void* intern_proc(void* param)
+{
+    const uintptr_t index = reinterpret_cast<uintptr_t>(param);
+    for (int i=0; i<STRING_NUMBER; ++i)
+    {
+        const int n = (index % 2 == 0)? i: STRING_NUMBER-1-i;
+        sg_interned[index][n] = sg_interner->intern(utils::CStringUtils::format_string("module.%d", n));
+    }
+    return NULL;
+}
+
+static bool test_basic()
+{
+    sys::CStringInterner interner;
+    const std::string str = "hbase.column";
+    const sys::CInternedString a = interner.intern(str);
+    const sys::CInternedString b = interner.intern(std::string_view("hbase.column"));
+    const sys::CInternedString c = interner.intern("redis.prefix");
+
+    // 内容相同的为同一对象，且不指向调用者的内存
+    if ((a != b) || (a == c) || (a.c_str() == str.c_str()) || (a.view() != str) || (strlen(a.c_str()) != a.size()))
+        return false;
+    if ((a.id() != 1) || (c.id() != 2) || (interner.size() != 3) || (std::hash<sys::CInternedString>()(a) != std::hash<sys::CInternedString>()(b)))
+        return false;
+
+    // 空串为0号，所有驻留表相同
+    const sys::CInternedString empty;
+    if ((interner.intern("") != empty) || !empty.empty() || (empty.id() != 0) || (0 != strcmp(empty.c_str(), "")))
+        return false;
+
+    sys::CInternedString found;
+    if (!interner.find("redis.prefix", &found) || (found != c) || interner.find("none", &found) || (interner.size() != 3))
+        return false;
+    return (interner.get(1) == a) && (interner.get(2) == c) && (interner.get(100) == empty) && (interner.get_allocated_bytes() > 0);
+}
+
+static bool test_concurrent()
+{
+    sys::CStringInterner interner;
+    pthread_t threads[THREAD_NUMBER];
+    sg_interner = &interner;
+    for (uintptr_t i=0; i<THREAD_NUMBER; ++i)
+        pthread_create(&threads[i], NULL, intern_proc, reinterpret_cast<void*>(i));
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        pthread_join(threads[i], NULL);
+
+    // ID连续且唯一，ID表与驻留的一致
+    if (interner.size() != STRING_NUMBER+1)
+    {
+        printf("size: %u\n", interner.size());
+        return false;
+    }
+    for (int n=0; n<STRING_NUMBER; ++n)
+    {
+        const sys::CInternedString& interned = sg_interned[0][n];
+        for (int i=1; i<THREAD_NUMBER; ++i)
+        {
+            if (sg_interned[i][n] != interned)
+                return false;
+        }
+        if ((interner.get(interned.id()) != interned) || (interned.view() != utils::CStringUtils::format_string("module.%d", n)))
+            return false;
+    }
+    printf("%u strings, %zu bytes\n", interner.size(), interner.get_allocated_bytes());
+    return true;
+}
+
+// 以驻留的名字和以字符串取得的是同一度量
+static bool test_metrics()
+{
+    sys::CMetricsRegistry* registry = sys::CMetricsRegistry::get_singleton();
+    const sys::CInternedString name = sys::CStringInterner::get_singleton()->intern("ut.interned_counter");
+    sys::CCounter* counter = registry->get_counter(name);
+    if ((counter != registry->get_counter(name)) || (counter != registry->get_counter("ut.interned_counter")))
+        return false;
+
+    sys::CCounter* other = registry->get_counter("ut.other_counter");
+    return (other == registry->get_counter(sys::CStringInterner::get_singleton()->intern("ut.other_counter")))
+        && (registry->get_histogram(name) == registry->get_histogram("ut.interned_counter"))
+        && (registry->get_gauge(name) == registry->get_gauge("ut.interned_counter"));
+}
+
+int main()
+{
+    try
+    {
+        if (!test_basic())
+        {
+            printf("test basic failed\n");
+            return 1;
+        }
+        if (!test_concurrent())
+        {
+            printf("test concurrent failed\n");
+            return 1;
+        }
+        if (!test_metrics())
+        {
+            printf("test metrics failed\n");
+            return 1;
+        }
+    }
+    catch (utils::CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("string interner ok\n");
+    return 0;
+}
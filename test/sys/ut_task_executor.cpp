@@ -0,0 +1,127 @@
+#include <mooon/sys/task_executor.h>
+#include <mooon/utils/exception.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static mooon::sys::CTaskExecutor executor;
+static volatile uint32_t sg_executed = 0;
+static volatile uint32_t sg_callbacks = 0;
+
+static void work(uint32_t microseconds)
+{
+    if (microseconds > 0)
+        usleep(microseconds);
+    __atomic_add_fetch(&sg_executed, 1, __ATOMIC_SEQ_CST);
+}
+
+// 在工作线程中再提交子任务
+static void split(uint32_t depth)
+{
+    __atomic_add_fetch(&sg_executed, 1, __ATOMIC_SEQ_CST);
+    if (depth > 0)
+    {
+        executor.submit(mooon::utils::bind<void>(&split, depth-1));
+        executor.submit(mooon::utils::bind<void>(&split, depth-1));
+    }
+}
+
+static void fail()
+{
+    THROW_EXCEPTION("task failed", 1);
+}
+
+static void on_done()
+{
+    __atomic_add_fetch(&sg_callbacks, 1, __ATOMIC_SEQ_CST);
+}
+
+// 记录分通道执行的次序
+static volatile bool sg_blocking = false;
+static char sg_order[64];
+static uint32_t sg_order_size = 0;
+
+static void block(uint32_t milliseconds)
+{
+    sg_blocking = true;
+    usleep(milliseconds * 1000);
+}
+
+static void record(char lane)
+{
+    sg_order[sg_order_size++] = lane;
+}
+
+// 只有一个工作线程，任务全部积压后再按通道的权重和截止时间执行
+static int test_lanes()
+{
+    mooon::sys::CTaskExecutor lane_executor;
+    std::vector<uint32_t> weights;
+    weights.push_back(4);
+    weights.push_back(1);
+    lane_executor.set_lanes(weights);
+    lane_executor.create(1);
+
+    lane_executor.submit(mooon::utils::bind<void>(&block, 100U));
+    while (!sg_blocking)
+        usleep(1000);
+
+    mooon::sys::CTaskFuture expired_future;
+    lane_executor.submit(mooon::utils::bind<void>(&record, 'x'), mooon::sys::CTaskPriority(0, mooon::sys::CClock::get_milliseconds()+1), &expired_future);
+    for (uint32_t i=0; i<10; ++i)
+    {
+        lane_executor.submit(mooon::utils::bind<void>(&record, 'b'), mooon::sys::CTaskPriority(1));
+        lane_executor.submit(mooon::utils::bind<void>(&record, 'i'));
+    }
+
+    lane_executor.destroy();
+    sg_order[sg_order_size] = '\0';
+    printf("lane order: %s, expired: %" PRIu64 "\n", sg_order, lane_executor.get_expired_number());
+    if ((std::string(sg_order).substr(0, 10) != "iibiiiibii") || (sg_order_size != 20))
+        return 1;
+    if (!expired_future.is_done() || !expired_future.is_failed() || (lane_executor.get_expired_number() != 1))
+        return 1;
+    return 0;
+}
+
+int main()
+{
+    executor.create(4);
+    printf("worker number: %u\n", executor.get_worker_number());
+
+    // 时长不均匀的任务，长任务集中在同一个队列上
+    mooon::sys::CTaskFuture futures[100];
+    for (uint32_t i=0; i<100; ++i)
+        executor.submit(mooon::utils::bind<void>(&work, (0 == i%4)? 2000U: 0U), &futures[i]);
+    for (uint32_t i=0; i<100; ++i)
+        futures[i].wait();
+    printf("executed: %u, stolen: %" PRIu64 "\n", sg_executed, executor.get_stolen_number());
+    if (sg_executed != 100)
+        return 1;
+
+    // 异常和完成回调
+    mooon::sys::CTaskFuture future;
+    executor.submit(mooon::utils::bind<void>(&fail), &future);
+    if (!future.timed_wait(10000) || !future.is_failed())
+        return 1;
+    printf("error: %s\n", future.get_error().c_str());
+
+    for (uint32_t i=0; i<10; ++i)
+        executor.submit(mooon::utils::bind<void>(&work, 0U), mooon::utils::bind<void>(&on_done));
+
+    // 2^11-1个递归任务，destroy要等它们全部执行完
+    executor.submit(mooon::utils::bind<void>(&split, 10U));
+    executor.destroy();
+    printf("executed: %u, callbacks: %u, total executed: %" PRIu64 "\n", sg_executed, sg_callbacks, executor.get_executed_number());
+    if ((sg_executed != 100+10+2047) || (sg_callbacks != 10) || (executor.get_pending_number() != 0))
+        return 1;
+
+    // 销毁后不能再提交
+    if (executor.submit(mooon::utils::bind<void>(&work, 0U)))
+        return 1;
+
+    if (test_lanes() != 0)
+        return 1;
+
+    printf("task executor ok\n");
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <mooon/sys/task_scheduler.h>
+#include <stdio.h>
+#include <string>
+MOOON_NAMESPACE_USE
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { printf("line %d: %s\n", __LINE__, #condition); return 1; } \
+    } while (0)
+
+int main()
+{
+    std::vector<uint32_t> weights;
+    weights.push_back(4);
+    weights.push_back(1);
+    sys::CTaskScheduler<std::string> scheduler(weights);
+    EXPECT(scheduler.get_lane_number() == 2);
+
+    // 两个通道都有积压时按4:1出队
+    for (int i=0; i<20; ++i)
+    {
+        std::string interactive = "i" + std::to_string(i);
+        std::string bulk = "b" + std::to_string(i);
+        scheduler.push(interactive, sys::CTaskPriority(0));
+        scheduler.push(bulk, sys::CTaskPriority(1));
+    }
+    EXPECT(scheduler.size() == 40);
+
+    std::string task;
+    std::string order;
+    int bulk_number = 0;
+    for (int i=0; i<25; ++i)
+    {
+        EXPECT(scheduler.pop(1, &task, NULL));
+        if ('b' == task[0])
+            ++bulk_number;
+        if (i < 5)
+            order += task;
+    }
+    EXPECT(order == "i0i1b0i2i3"); // 同一通道内先进先出
+    EXPECT(5 == bulk_number);
+
+    // 只剩批量的通道时，它独占
+    for (int i=0; i<15; ++i)
+    {
+        EXPECT(scheduler.pop(1, &task, NULL));
+        EXPECT(task == "b" + std::to_string(i+5));
+    }
+    EXPECT(!scheduler.pop(1, &task, NULL));
+    EXPECT(scheduler.empty());
+
+    // 通道内按截止时间最早的先出，都先于没有截止时间的，相同的截止时间先进先出
+    std::string a = "a", b = "b", c = "c", d = "d", e = "e";
+    scheduler.push(a);
+    scheduler.push(b, sys::CTaskPriority(0, 300));
+    scheduler.push(c, sys::CTaskPriority(0, 100));
+    scheduler.push(d, sys::CTaskPriority(0, 300));
+    scheduler.push(e, sys::CTaskPriority(9, 200)); // 超出通道数归入最后一个通道
+    EXPECT(scheduler.get_lane_size(0) == 4);
+    EXPECT(scheduler.get_lane_size(1) == 1);
+    order.clear();
+    while (scheduler.pop(50, &task, NULL))
+        order += task;
+    EXPECT(order == "cbeda");
+
+    // 已过截止时间的不出队，交给调用者丢弃
+    std::string f = "f", g = "g", h = "h";
+    scheduler.push(f, sys::CTaskPriority(0, 100));
+    scheduler.push(g, sys::CTaskPriority(1, 99));
+    scheduler.push(h, sys::CTaskPriority(0, 101));
+    std::vector<std::string> expired;
+    EXPECT(scheduler.pop(101, &task, &expired));
+    EXPECT(task == "h");
+    EXPECT(expired.size() == 2);
+    EXPECT(scheduler.empty());
+    EXPECT(scheduler.drop_expired(1000, NULL) == 0);
+
+    printf("task scheduler ok\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <mooon/sys/mem_pool.h>
+#include <mooon/sys/pool_thread.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/thread_pool.h>
+#include <algorithm>
+#include <sched.h>
+#include <stdio.h>
+
+static volatile int sg_misplaced = 0;   // 运行在绑定CPU之外的线程数
+static volatile int sg_checked = 0;     // 已检查过的线程数
+
+class CPlacedThread: public mooon::sys::CPoolThread
+{
+private:
+    virtual void before_start()
+    {
+        // 在本线程所在的节点上创建内存池
+        _mem_pool.create(64, 1024, false, 1, 'm', get_numa_node());
+    }
+
+    virtual void run()
+    {
+        const std::vector<int>& cpus = get_cpu_affinity();
+        const int cpu = sched_getcpu();
+
+        if (!cpus.empty() && (std::find(cpus.begin(), cpus.end(), cpu) == cpus.end()))
+            __atomic_add_fetch(&sg_misplaced, 1, __ATOMIC_SEQ_CST);
+        if ((NULL == _mem_pool.allocate()) || (_mem_pool.get_available_number() != 1023))
+            __atomic_add_fetch(&sg_misplaced, 1, __ATOMIC_SEQ_CST);
+        printf("thread[%u] node[%d] cpu[%d]\n", get_index(), get_numa_node(), cpu);
+
+        __atomic_add_fetch(&sg_checked, 1, __ATOMIC_SEQ_CST);
+        do_millisleep(-1);
+    }
+
+private:
+    mooon::sys::CRawMemPool _mem_pool;
+};
+
+static volatile int sg_engine_cpu = -1;
+
+static void engine_proc()
+{
+    sg_engine_cpu = sched_getcpu();
+}
+
+int main()
+{
+    const uint16_t cpu_number = mooon::sys::CUtils::get_cpu_number();
+    printf("cpu number: %u, numa node number: %u\n", cpu_number, mooon::sys::CUtils::get_numa_node_number());
+
+    std::vector<int> node0_cpus;
+    if (!mooon::sys::CUtils::get_numa_node_cpus(0, &node0_cpus) || node0_cpus.empty())
+        return 1;
+    if (mooon::sys::CUtils::get_numa_node_cpus(-1, &node0_cpus))
+        return 1;
+
+    // 各策略的放置结果
+    mooon::sys::CThreadPlacement none;
+    mooon::sys::CThreadPlacement compact(mooon::sys::placement_compact);
+    mooon::sys::CThreadPlacement numa_node(mooon::sys::placement_numa_node);
+    if (!none.get_cpus(0).empty() || (none.get_numa_node(0) != -1))
+        return 1;
+    if ((compact.get_cpus(0).size() != 1) || (compact.get_numa_node(0) < 0))
+        return 1;
+    if (numa_node.get_cpus(0).empty() || (numa_node.get_numa_node(0) < 0))
+        return 1;
+
+    std::vector<int> explicit_cpus;
+    explicit_cpus.push_back(0);
+    mooon::sys::CThreadPlacement explicit_placement(mooon::sys::placement_explicit, explicit_cpus);
+    if ((explicit_placement.get_cpus(5).size() != 1) || (explicit_placement.get_cpus(5)[0] != 0))
+        return 1;
+
+    // 线程数多于CPU数时循环使用
+    const mooon::sys::placement_policy_t policies[] = { mooon::sys::placement_compact, mooon::sys::placement_scatter, mooon::sys::placement_numa_node };
+    for (size_t i=0; i<sizeof(policies)/sizeof(policies[0]); ++i)
+    {
+        const uint16_t thread_count = cpu_number + 1;
+        mooon::sys::CThreadPool<CPlacedThread> thread_pool;
+
+        sg_checked = 0;
+        thread_pool.create(thread_count, NULL, mooon::sys::CThreadPlacement(policies[i]));
+        thread_pool.activate();
+        while (sg_checked < thread_count)
+            sched_yield();
+        thread_pool.destroy();
+    }
+    if (sg_misplaced != 0)
+    {
+        printf("%d threads misplaced\n", sg_misplaced);
+        return 1;
+    }
+
+    // CThreadEngine指定栈大小和CPU
+    {
+        const std::vector<int> cpus = compact.get_cpus(0);
+        mooon::sys::CThreadEngine engine(mooon::sys::bind(&engine_proc), 256*1024, cpus);
+        engine.join();
+        if (sg_engine_cpu != cpus[0])
+            return 1;
+    }
+
+    printf("thread placement ok\n");
+    return 0;
+}
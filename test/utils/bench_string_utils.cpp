@@ -0,0 +1,58 @@
+// 对比各指令集下CStringUtils相关函数的速度
+#include "mooon/utils/string_simd.h"
+#include "mooon/utils/string_utils.h"
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+UTILS_NAMESPACE_USE
+
+static uint64_t get_current_nanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 返回每秒处理的MB数
+template <typename Function>
+static double measure(Function function, size_t size, int rounds)
+{
+    const uint64_t begin = get_current_nanoseconds();
+    for (int i=0; i<rounds; ++i)
+        function();
+    const uint64_t nanoseconds = get_current_nanoseconds() - begin;
+    return (static_cast<double>(size) * rounds / (1024*1024)) / (static_cast<double>(nanoseconds) / 1000000000);
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t size = (argc > 1)? static_cast<size_t>(atoi(argv[1])): 4096;
+    const int rounds = (argc > 2)? atoi(argv[2]): 20000;
+    static const char* isa_names[] = { "scalar", "sse4.2", "avx2" };
+
+    std::string text(size, '\0');
+    for (size_t i=0; i<size; ++i)
+        text[i] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"[random() % 52];
+    const std::string digits(size, '7');
+    const std::string spaces = std::string(size/2, ' ') + "x" + std::string(size/2, '\t');
+
+    printf("size=%zu, rounds=%d (MB/s)\n", size, rounds);
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "isa", "to_upper", "to_lower", "trim", "numeric", "alpha", "to_hex");
+    const CStringSimd::isa_t supported_isa = CStringSimd::get_supported_isa();
+    for (int isa=CStringSimd::isa_scalar; isa<=supported_isa; ++isa)
+    {
+        CStringSimd::set_isa(static_cast<CStringSimd::isa_t>(isa));
+        std::string str = text;
+        volatile size_t sink = 0;
+
+        const double upper = measure([&]() { CStringUtils::to_upper(str); }, size, rounds);
+        const double lower = measure([&]() { CStringUtils::to_lower(str); }, size, rounds);
+        const double trim = measure([&]() { sink = sink + CStringUtils::trim(spaces).size(); }, size, rounds);
+        const double numeric = measure([&]() { sink = sink + CStringUtils::is_numeric_string(digits.c_str()); }, size, rounds);
+        const double alpha = measure([&]() { sink = sink + CStringUtils::is_alphabetic_string(text.c_str()); }, size, rounds);
+        const double hex = measure([&]() { sink = sink + CStringUtils::to_hex(text).size(); }, size, rounds);
+        printf("%-8s %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f\n", isa_names[isa], upper, lower, trim, numeric, alpha, hex);
+    }
+
+    return 0;
+}
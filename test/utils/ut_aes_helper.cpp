@@ -0,0 +1,186 @@
+#include "mooon/utils/aes_helper.h"
+#include "mooon/utils/rsa_helper.h"
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <stdlib.h>
+UTILS_NAMESPACE_USE
+
+// NIST SP 800-38D的测试向量（Test Case 3）
+static bool test_gcm_vector()
+{
+    const std::string key("\xfe\xff\xe9\x92\x86\x65\x73\x1c\x6d\x6a\x8f\x94\x67\x30\x83\x08", 16);
+    const std::string iv("\xca\xfe\xba\xbe\xfa\xce\xdb\xad\xde\xca\xf8\x88", 12);
+    const std::string plain(
+        "\xd9\x31\x32\x25\xf8\x84\x06\xe5\xa5\x59\x09\xc5\xaf\xf5\x26\x9a\x86\xa7\xa9\x53\x15\x34\xf7\xda\x2e\x4c\x30\x3d\x8a\x31\x8a\x72"
+        "\x1c\x3c\x0c\x95\x95\x68\x09\x53\x2f\xcf\x0e\x24\x49\xa6\xb5\x25\xb1\x6a\xed\xf5\xaa\x0d\xe6\x57\xba\x63\x7b\x39\x1a\xaf\xd2\x55", 64);
+    const std::string tag("\x4d\x5c\x2a\xf3\x27\xcd\x64\xa6\x2c\xf3\x5a\xbd\x2b\xa6\xfa\xb4", 16);
+
+    CAESCipher cipher(key);
+    std::string encrypted;
+    cipher.encrypt(iv.data(), iv.size(), plain, &encrypted);
+    if ((encrypted.size() != 80) || (encrypted.substr(64) != tag) || (encrypted.substr(0, 4) != "\x42\x83\x1e\xc2"))
+        return false;
+
+    std::string decrypted;
+    if (!cipher.decrypt(iv.data(), iv.size(), encrypted, &decrypted) || (decrypted != plain))
+        return false;
+
+    // 篡改后校验失败
+    encrypted[10] ^= 1;
+    return !cipher.decrypt(iv.data(), iv.size(), encrypted, &decrypted) && decrypted.empty();
+}
+
+// iovec分段加密与整体加密结果相同，同一个对象重复使用
+static bool test_stream(CAESCipher::cipher_mode_t mode)
+{
+    const std::string key(32, 'k');
+    char iv[16] = { 0 };
+    const size_t iv_size = (CAESCipher::mode_gcm == mode)? CAESCipher::gcm_iv_size: CAESCipher::ctr_iv_size;
+    std::string plain(100000, '\0');
+    for (size_t i=0; i<plain.size(); ++i)
+        plain[i] = static_cast<char>(random());
+
+    CAESCipher cipher(key, mode);
+    for (int round=0; round<3; ++round)
+    {
+        iv[0] = static_cast<char>(round);
+        std::string whole;
+        cipher.encrypt(iv, iv_size, plain, &whole);
+
+        struct iovec iov[3] = {
+            { const_cast<char*>(plain.data()), 7 },
+            { const_cast<char*>(plain.data()+7), 40000 },
+            { const_cast<char*>(plain.data()+40007), plain.size()-40007 } };
+        std::string pieces(plain.size(), '\0');
+        char tag[CAESCipher::gcm_tag_size];
+        cipher.begin_encrypt(iv, iv_size);
+        if (cipher.update(iov, 3, &pieces[0]) != plain.size())
+            return false;
+        cipher.finish_encrypt(tag);
+        if (pieces != whole.substr(0, plain.size()))
+            return false;
+        if ((CAESCipher::mode_gcm == mode) && (0 != memcmp(tag, whole.data()+plain.size(), sizeof(tag))))
+            return false;
+
+        // 原地解密
+        cipher.begin_decrypt(iv, iv_size);
+        cipher.update(pieces.data(), pieces.size(), &pieces[0]);
+        if (!cipher.finish_decrypt(tag) || (pieces != plain))
+            return false;
+    }
+
+    return true;
+}
+
+static bool test_aes_helper()
+{
+    CAESHelper aes("0123456789");
+    std::string encrypted;
+    std::string decrypted;
+    aes.encrypt("hello world, this is mooon", &encrypted);
+    aes.decrypt(encrypted, &decrypted);
+    return (32 == encrypted.size()) && (decrypted == std::string("hello world, this is mooon") + std::string(6, '\0'));
+}
+
+static std::string generate_rsa_key(bool is_private, std::string* pub_key)
+{
+    RSA* rsa = RSA_new();
+    BIGNUM* e = BN_new();
+    BN_set_word(e, RSA_F4);
+    RSA_generate_key_ex(rsa, 2048, e, NULL);
+
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_RSAPrivateKey(bio, rsa, NULL, NULL, 0, NULL, NULL);
+    char* data;
+    long size = BIO_get_mem_data(bio, &data);
+    std::string priv_key(data, size);
+    BIO_free(bio);
+
+    bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_RSA_PUBKEY(bio, rsa);
+    size = BIO_get_mem_data(bio, &data);
+    pub_key->assign(data, size);
+    BIO_free(bio);
+    BN_free(e);
+    RSA_free(rsa);
+    return is_private? priv_key: *pub_key;
+}
+
+static bool test_rsa()
+{
+    std::string pub_key;
+    const std::string priv_key = generate_rsa_key(true, &pub_key);
+
+    char keyfile[] = "/tmp/ut_aes_helper.XXXXXX";
+    int fd = mkstemp(keyfile);
+    if ((fd == -1) || (write(fd, priv_key.data(), priv_key.size()) != static_cast<ssize_t>(priv_key.size())))
+        return false;
+    close(fd);
+
+    CRSAKey public_key;
+    CRSAKey private_key;
+    public_key.load_public_key(pub_key);
+    private_key.load_private_keyfile(keyfile);
+
+    std::vector<std::string> tokens;
+    for (int i=0; i<10; ++i)
+        tokens.push_back(std::string("token") + CStringUtils::int_tostring(i));
+    std::vector<std::string> encrypted;
+    std::vector<std::string> decrypted;
+    public_key.public_encrypt(tokens, &encrypted, PKCS1_OAEP_PADDING);
+    private_key.private_decrypt(encrypted, &decrypted, PKCS1_OAEP_PADDING);
+    if ((decrypted != tokens) || (encrypted[0].size() != 256))
+        return false;
+
+    // 静态接口的结果相同，重复调用使用缓存的密钥
+    std::string outstr;
+    for (int i=0; i<3; ++i)
+    {
+        CRSAHelper::private_decrypt_bykeyfile(keyfile, encrypted[i], &outstr, PKCS1_OAEP_PADDING);
+        if (outstr != tokens[i])
+            return false;
+    }
+    std::string signature;
+    CRSAHelper::private_encrypt_bykey(priv_key, "digest", &signature, PKCS1_PADDING);
+    CRSAHelper::public_decrypt_bykey(pub_key, signature, &outstr, PKCS1_PADDING);
+    unlink(keyfile);
+    if (outstr != "digest")
+        return false;
+
+    // 明文过长
+    try
+    {
+        public_key.public_encrypt(std::string(300, 'x'), &outstr, PKCS1_PADDING);
+        return false;
+    }
+    catch (CException& ex)
+    {
+        printf("%s\n", ex.what());
+    }
+    return true;
+}
+
+int main()
+{
+    try
+    {
+        if (!test_gcm_vector())
+            return 1;
+        if (!test_stream(CAESCipher::mode_gcm))
+            return 1;
+        if (!test_stream(CAESCipher::mode_ctr))
+            return 1;
+        if (!test_aes_helper())
+            return 1;
+        if (!test_rsa())
+            return 1;
+    }
+    catch (CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    printf("aes helper ok\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "mooon/utils/bitmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+UTILS_NAMESPACE_USE
+
+static const char* isa_name(CStringSimd::isa_t isa)
+{
+    return (CStringSimd::isa_avx2 == isa)? "avx2": ((CStringSimd::isa_sse42 == isa)? "popcnt": "scalar");
+}
+
+static void random_fill(CBitmap* bitmap, std::vector<bool>* reference, int percent)
+{
+    for (size_t i=0; i<bitmap->size(); ++i)
+    {
+        const bool bit = (random() % 100) < percent;
+        (*reference)[i] = bit;
+        if (bit)
+            bitmap->set(i);
+    }
+}
+
+static bool equals(const CBitmap& bitmap, const std::vector<bool>& reference)
+{
+    size_t count = 0;
+    for (size_t i=0; i<reference.size(); ++i)
+    {
+        if (bitmap.test(i) != reference[i])
+            return false;
+        count += reference[i]? 1: 0;
+    }
+    return count == bitmap.count();
+}
+
+// 单个位、范围和查找，范围的边界取在字内、字的边界和跨多个字
+static bool test_bits()
+{
+    const size_t bit_number = 1000;
+    CBitmap bitmap(bit_number);
+    std::vector<bool> reference(bit_number, false);
+
+    if (bitmap.any() || (0 != bitmap.find_first_zero()) || (CBitmap::npos != bitmap.find_first_set()))
+        return false;
+
+    const size_t ranges[][2] = { {3, 7}, {60, 70}, {128, 192}, {200, 900}, {999, 1000}, {5, 5} };
+    for (size_t r=0; r<sizeof(ranges)/sizeof(ranges[0]); ++r)
+    {
+        bitmap.set(ranges[r][0], ranges[r][1]);
+        for (size_t i=ranges[r][0]; i<ranges[r][1]; ++i)
+            reference[i] = true;
+    }
+    bitmap.reset(300, 331);
+    bitmap.reset(64, 65);
+    for (size_t i=300; i<331; ++i)
+        reference[i] = false;
+    reference[64] = false;
+    bitmap.flip(1);
+    reference[1] = true;
+    if (!equals(bitmap, reference))
+        return false;
+
+    size_t count = 0;
+    for (size_t i=100; i<850; ++i)
+        count += reference[i]? 1: 0;
+    if (count != bitmap.count(100, 850))
+        return false;
+
+    // 查找的结果和逐位查找相同
+    for (size_t from=0; from<bit_number; ++from)
+    {
+        size_t set = from, zero = from;
+        while ((set < bit_number) && !reference[set]) ++set;
+        while ((zero < bit_number) && reference[zero]) ++zero;
+        if ((((set == bit_number)? CBitmap::npos: set) != bitmap.find_first_set(from))
+         || (((zero == bit_number)? CBitmap::npos: zero) != bitmap.find_first_zero(from)))
+        {
+            printf("find from %zu failed\n", from);
+            return false;
+        }
+    }
+
+    // 末尾超出位数的位不影响计数和查找
+    bitmap.set_all();
+    printf("bits: count=%zu after set_all, first zero=%zu\n", bitmap.count(), bitmap.find_first_zero());
+    if ((bit_number != bitmap.count()) || (CBitmap::npos != bitmap.find_first_zero()))
+        return false;
+    bitmap.resize(70);
+    bitmap.resize(200);
+    return (70 == bitmap.count()) && (70 == bitmap.find_first_zero());
+}
+
+// 各指令集的运算结果都和逐位计算的相同
+static bool test_operations(CStringSimd::isa_t isa)
+{
+    const size_t bit_number = 100003; // 不是256的倍数，覆盖向量实现剩下的部分
+    CBitmap a(bit_number), b(bit_number);
+    std::vector<bool> ra(bit_number), rb(bit_number);
+    random_fill(&a, &ra, 30);
+    random_fill(&b, &rb, 60);
+
+    size_t and_count = 0;
+    std::vector<bool> r_and(bit_number), r_or(bit_number), r_xor(bit_number), r_and_not(bit_number);
+    for (size_t i=0; i<bit_number; ++i)
+    {
+        r_and[i] = ra[i] && rb[i];
+        r_or[i] = ra[i] || rb[i];
+        r_xor[i] = ra[i] != rb[i];
+        r_and_not[i] = ra[i] && !rb[i];
+        and_count += r_and[i]? 1: 0;
+    }
+
+    CStringSimd::isa_t used = CBitmap::set_isa(isa);
+    CBitmap x = a; x &= b;
+    CBitmap y = a; y |= b;
+    CBitmap z = a; z ^= b;
+    CBitmap w = a; w.and_not(b);
+    printf("operations: isa=%s, and_count=%zu\n", isa_name(used), a.and_count(b));
+    return equals(x, r_and) && equals(y, r_or) && equals(z, r_xor) && equals(w, r_and_not)
+        && (and_count == a.and_count(b)) && (x.count() == and_count) && (x != y) && (x == x);
+}
+
+int main()
+{
+    if (!test_bits())
+        return 1;
+
+    const CStringSimd::isa_t supported_isa = CStringSimd::get_supported_isa();
+    for (int isa=CStringSimd::isa_scalar; isa<=supported_isa; ++isa)
+    {
+        if (!test_operations(static_cast<CStringSimd::isa_t>(isa)))
+            return 1;
+    }
+
+    printf("bitmap ok\n");
+    return 0;
+}
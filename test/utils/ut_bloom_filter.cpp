@@ -0,0 +1,126 @@
+#include "mooon/utils/bloom_filter.h"
+#include "mooon/utils/string_utils.h"
+#include <inttypes.h>
+#include <stdio.h>
+UTILS_NAMESPACE_USE
+
+static std::string make_key(const char* prefix, int i)
+{
+    return std::string(prefix) + CStringUtils::int_tostring(i);
+}
+
+// 没有漏判，误判率接近预期
+static bool test_bloom_filter()
+{
+    const int number = 100000;
+    CBloomFilter filter(number, 0.01);
+    for (int i=0; i<number; ++i)
+        filter.add(make_key("in", i));
+    for (int i=0; i<number; ++i)
+    {
+        if (!filter.contains(make_key("in", i)))
+            return false;
+    }
+
+    int false_positives = 0;
+    for (int i=0; i<number; ++i)
+        false_positives += filter.contains(make_key("out", i))? 1: 0;
+    const double fpp = static_cast<double>(false_positives) / number;
+    printf("bloom: %" PRIu64" bits, %u hashes, fpp=%.4f, estimated=%.4f\n", filter.get_bit_number(), filter.get_hash_number(), fpp, filter.estimate_fpp());
+    if ((fpp > 0.015) || (filter.estimate_fpp() > 0.02))
+        return false;
+
+    // 去重
+    CBloomFilter dedup(1000, 0.001);
+    if (dedup.test_and_add("message1") || !dedup.test_and_add("message1") || dedup.test_and_add("message2"))
+        return false;
+
+    // 合并得到并集，形状不同的不能合并
+    CBloomFilter other(1000, 0.001);
+    other.add("message3");
+    if (!dedup.merge(other) || !dedup.contains("message3") || filter.merge(other))
+        return false;
+
+    // 序列化后载入和attach的结果相同，attach后的修改写入buffer
+    const std::string data = filter.serialize();
+    CBloomFilter loaded;
+    std::vector<uint64_t> buffer(data.size() / 8 + 1);
+    memcpy(&buffer[0], data.data(), data.size());
+    CBloomFilter attached;
+    if (!loaded.load(data.data(), data.size()) || !attached.attach(&buffer[0], data.size()) || loaded.attach(&buffer[0], data.size() - 1))
+        return false;
+    if (!loaded.contains(make_key("in", 7)) || !attached.contains(make_key("in", 7)) || !attached.is_attached())
+        return false;
+    attached.add("new");
+    CBloomFilter reloaded;
+    return reloaded.load(&buffer[0], data.size()) && reloaded.contains("new") && !loaded.contains("new") && !other.load(data.data(), 10);
+}
+
+static bool test_cuckoo_filter()
+{
+    const int number = 100000;
+    CCuckooFilter filter(number);
+    for (int i=0; i<number; ++i)
+    {
+        if (!filter.add(make_key("in", i)))
+            return false;
+    }
+
+    int false_positives = 0;
+    for (int i=0; i<number; ++i)
+    {
+        if (!filter.contains(make_key("in", i)))
+            return false;
+        false_positives += filter.contains(make_key("out", i))? 1: 0;
+    }
+    printf("cuckoo: %" PRIu64" buckets, %" PRIu64" keys, %d false positives\n", filter.get_bucket_number(), filter.size(), false_positives);
+    if (false_positives > number / 1000)
+        return false;
+
+    // 删除后不再存在（除误判外），其余的不受影响
+    int remaining = 0;
+    for (int i=0; i<number; i+=2)
+    {
+        if (!filter.remove(make_key("in", i)))
+            return false;
+    }
+    for (int i=0; i<number; i+=2)
+        remaining += filter.contains(make_key("in", i))? 1: 0;
+    for (int i=1; i<number; i+=2)
+    {
+        if (!filter.contains(make_key("in", i)))
+            return false;
+    }
+    printf("cuckoo: %d removed keys still contained\n", remaining);
+    if ((remaining > number / 1000) || (static_cast<uint64_t>(number / 2) != filter.size()))
+        return false;
+
+    // 满时add失败，负载接近上限
+    CCuckooFilter small(1000);
+    int added = 0;
+    while (small.add(make_key("full", added)))
+        ++added;
+    const uint64_t slots = small.get_bucket_number() * 4;
+    printf("cuckoo: full at %d of %" PRIu64" slots\n", added, slots);
+    if ((added < static_cast<int>(slots * 9 / 10)) || !small.contains(make_key("full", 0)))
+        return false;
+
+    // 删除一些后又可以加入
+    for (int i=0; i<100; ++i)
+    {
+        if (!small.remove(make_key("full", i)))
+            return false;
+    }
+    return small.add(make_key("full", added + 1)) && small.contains(make_key("full", added - 1));
+}
+
+int main()
+{
+    if (!test_bloom_filter())
+        return 1;
+    if (!test_cuckoo_filter())
+        return 1;
+
+    printf("bloom filter ok\n");
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include "mooon/utils/charset_utils.h"
+#include "mooon/sys/datetime_utils.h"
+#include "mooon/utils/string_utils.h"
+#include <pthread.h>
+#include <string>
+using namespace mooon;
+using namespace mooon::utils;
+
+// 不经过缓存和ASCII快速路径，直接用iconv一次转换整个输入，作为对比的参照
+static std::string reference_convert(const char* from_charset, const char* to_charset, const std::string& from)
+{
+    iconv_t cd = iconv_open(to_charset, from_charset);
+    std::string to(from.size()*4 + 16, '\0');
+    char* in_buf = const_cast<char*>(from.data());
+    size_t in_bytes_left = from.size();
+    char* out_buf = &to[0];
+    size_t out_bytes_left = to.size();
+
+    (void)iconv(cd, &in_buf, &in_bytes_left, &out_buf, &out_bytes_left);
+    iconv_close(cd);
+    to.resize(to.size() - out_bytes_left);
+    return to;
+}
+
+static bool check(const char* name, const std::string& result, const std::string& expected)
+{
+    if (result == expected)
+        return true;
+
+    printf("%s mismatch: %zu bytes, expected %zu bytes\n", name, result.size(), expected.size());
+    return false;
+}
+
+// 各种ASCII和非ASCII的组合，与整体转换的结果相同
+static bool test_mixed()
+{
+    static const char* utf8_strings[] =
+    {
+        "",
+        "hello world",
+        "中文",
+        "中文abc",
+        "abc中文",
+        "a中b文c",
+        "0123456789abcdefghijklmnopqrstuvwxyz中文0123456789abcdefghijklmnopqrstuvwxyz",
+        "中华人民共和国0123456789abcdefghij中华人民共和国0123456789abcdefghij",
+        "丂0123456789abcdefghij", // gbk为0x81 0x40，第二个字节是'@'
+        "😀0123456789abcdefghij"  // gb18030为4字节，第二和第四个字节是数字
+    };
+
+    for (size_t i=0; i<sizeof(utf8_strings)/sizeof(utf8_strings[0]); ++i)
+    {
+        const std::string utf8 = utf8_strings[i];
+        const std::string gb18030 = reference_convert("utf-8", "gb18030", utf8);
+        std::string result;
+
+        CCharsetUtils::convert("utf-8", "gb18030", utf8, &result);
+        if (!check("utf-8 to gb18030", result, gb18030))
+            return false;
+        CCharsetUtils::convert("gb18030", "utf-8", gb18030, &result);
+        if (!check("gb18030 to utf-8", result, utf8))
+            return false;
+        if (i + 1 == sizeof(utf8_strings)/sizeof(utf8_strings[0]))
+            break; // gbk不能表示emoji
+
+        const std::string gbk = reference_convert("utf-8", "gbk", utf8);
+        CCharsetUtils::utf8_to_gbk(utf8, &result);
+        if (!check("utf8_to_gbk", result, gbk))
+            return false;
+        CCharsetUtils::gbk_to_utf8(gbk, &result);
+        if (!check("gbk_to_utf8", result, utf8))
+            return false;
+
+        // 非ASCII兼容的字符集走整体转换
+        CCharsetUtils::convert("utf-8", "utf-16le", utf8, &result);
+        if (!check("utf-8 to utf-16le", result, reference_convert("utf-8", "utf-16le", utf8)))
+            return false;
+    }
+
+    // to和from是同一个对象
+    std::string str = "abc中文def";
+    CCharsetUtils::utf8_to_gbk(str, &str);
+    CCharsetUtils::gbk_to_utf8(str, &str);
+    return check("same object", str, "abc中文def");
+}
+
+static bool test_error()
+{
+    const std::string invalid = "abc\xff中文\xfe" "def";
+    std::string result;
+
+    CCharsetUtils::utf8_to_gbk(invalid, &result);
+    if (result != reference_convert("utf-8", "gbk", "abc中文def"))
+        return false;
+    CCharsetUtils::utf8_to_gbk(invalid, &result, true, false);
+    if (result != reference_convert("utf-8", "gbk", "abc") + "\xff" + reference_convert("utf-8", "gbk", "中文") + "\xfe" "def")
+        return false;
+
+    try
+    {
+        CCharsetUtils::utf8_to_gbk(invalid, &result, false);
+        return false;
+    }
+    catch (CException& ex)
+    {
+        printf("invalid: %s\n", ex.str().c_str());
+    }
+
+    // 结尾不完整的多字节字符
+    CCharsetUtils::gbk_to_utf8("abc\xd6", &result);
+    return "abc" == result;
+}
+
+// 转换到调用者提供的缓冲区
+static bool test_buffer()
+{
+    const std::string utf8 = "hello，世界！0123456789abcdefghij";
+    const std::string gbk = reference_convert("utf-8", "gbk", utf8);
+    char buffer[100];
+    size_t size = sizeof(buffer);
+
+    CCharsetUtils::utf8_to_gbk(utf8.data(), utf8.size(), buffer, &size);
+    if (std::string(buffer, size) != gbk)
+        return false;
+    size = sizeof(buffer);
+    CCharsetUtils::gbk_to_utf8(gbk.data(), gbk.size(), buffer, &size);
+    if (std::string(buffer, size) != utf8)
+        return false;
+
+    // 空间不足
+    for (size_t i=0; i<utf8.size(); ++i)
+    {
+        size = i;
+        try
+        {
+            CCharsetUtils::gbk_to_utf8(gbk.data(), gbk.size(), buffer, &size);
+            return false;
+        }
+        catch (CException& ex)
+        {
+            if (ex.errcode() != E2BIG)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// 每个线程有自己的缓存，线程退出时关闭
+static void* convert_thread(void* param)
+{
+    bool* ok = static_cast<bool*>(param);
+    std::string result;
+    for (int i=0; i<100; ++i)
+    {
+        CCharsetUtils::utf8_to_gbk("线程thread", &result);
+        CCharsetUtils::gbk_to_utf8(result, &result);
+        if (result != "线程thread")
+            return NULL;
+    }
+
+    *ok = true;
+    return NULL;
+}
+
+static bool test_thread()
+{
+    bool ok[4] = { false, false, false, false };
+    pthread_t threads[4];
+    for (int i=0; i<4; ++i)
+        pthread_create(&threads[i], NULL, convert_thread, &ok[i]);
+    for (int i=0; i<4; ++i)
+        pthread_join(threads[i], NULL);
+    return ok[0] && ok[1] && ok[2] && ok[3];
+}
+
+// UTF-8和UTF-16互转，与iconv的结果比较
+static bool test_utf16()
+{
+    static const char* utf8_strings[] =
+    {
+        "",
+        "hello world",
+        "中文",
+        "0123456789abcdefghijklmnopqrstuvwxyz中文0123456789abcdefghijklmnopqrstuvwxyz",
+        "a\xc3\xa9" "b\xef\xbf\xbf😀0123456789abcdefghij\xf4\x8f\xbf\xbf"
+    };
+
+    for (size_t i=0; i<sizeof(utf8_strings)/sizeof(utf8_strings[0]); ++i)
+    {
+        const std::string utf8 = utf8_strings[i];
+        const std::string expected = reference_convert("utf-8", "utf-16le", utf8);
+        std::u16string utf16;
+        std::string result;
+
+        CCharsetUtils::utf8_to_utf16(utf8, &utf16);
+        if (!check("utf8_to_utf16", std::string(reinterpret_cast<const char*>(utf16.data()), utf16.size()*2), expected))
+            return false;
+        CCharsetUtils::utf16_to_utf8(utf16, &result);
+        if (!check("utf16_to_utf8", result, utf8))
+            return false;
+        if (!CCharsetUtils::is_utf8(utf8))
+            return false;
+    }
+
+    size_t error_offset = 0;
+    std::u16string utf16;
+    if (CCharsetUtils::is_utf8("abc\xe4\xb8", &error_offset) || (error_offset != 3))
+        return false;
+    try
+    {
+        CCharsetUtils::utf8_to_utf16("0123456789abcdefghij\xed\xa0\x80", &utf16);
+        return false;
+    }
+    catch (CException& ex)
+    {
+        if (ex.errcode() != EILSEQ)
+            return false;
+    }
+    try
+    {
+        std::string result;
+        CCharsetUtils::utf16_to_utf8(std::u16string(u"abc") + static_cast<char16_t>(0xD83D), &result);
+        return false;
+    }
+    catch (CException& ex)
+    {
+        return ex.errcode() == EILSEQ;
+    }
+}
+
+// 查表的gbk_to_utf8与iconv的结果相同，包括出错时的各种处理方式
+static bool test_gbk_table()
+{
+    static const unsigned char bytes[] = { 'a', '@', 0x7f, 0x80, 0x81, 0xa1, 0xa2, 0xd6, 0xd0, 0xfe, 0xff, 0x40, 0xb0, 0xc4 };
+    for (int n=0; n<20000; ++n)
+    {
+        std::string gbk;
+        const size_t size = random() % 40;
+        for (size_t i=0; i<size; ++i)
+        {
+            if (random() % 4 == 0)
+                gbk.push_back(static_cast<char>(random() % 256));
+            else
+                gbk.push_back(static_cast<char>(bytes[random() % sizeof(bytes)]));
+        }
+
+        for (int flags=0; flags<4; ++flags)
+        {
+            const bool ignore_error = (flags & 1) != 0;
+            const bool skip_error = (flags & 2) != 0;
+            std::string result, expected;
+            int errcode = 0, expected_errcode = 0;
+
+            try
+            {
+                CCharsetUtils::gbk_to_utf8(gbk, &result, ignore_error, skip_error);
+            }
+            catch (CException& ex)
+            {
+                errcode = ex.errcode();
+            }
+            try
+            {
+                CCharsetUtils::convert("gbk", "utf-8", gbk, &expected, ignore_error, skip_error);
+            }
+            catch (CException& ex)
+            {
+                expected_errcode = ex.errcode();
+            }
+
+            if ((errcode != expected_errcode) || ((0 == errcode) && (result != expected)))
+            {
+                printf("gbk table mismatch: flags=%d, errcode=%d/%d, %s\n", flags, errcode, expected_errcode, CStringUtils::to_hex(gbk).c_str());
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// 九成是ASCII的gbk
+static void bench()
+{
+    std::string gbk;
+    for (int i=0; i<10000; ++i)
+        gbk += reference_convert("utf-8", "gbk", "GET /index.html?name=张三&city=深圳 HTTP/1.1\r\n");
+
+    std::string result;
+    const uint64_t begin = sys::CDatetimeUtils::get_current_microseconds();
+    for (int i=0; i<20; ++i)
+        CCharsetUtils::gbk_to_utf8(gbk, &result);
+    const uint64_t middle = sys::CDatetimeUtils::get_current_microseconds();
+    for (int i=0; i<20; ++i)
+        result = reference_convert("gbk", "utf-8", gbk);
+    const uint64_t end = sys::CDatetimeUtils::get_current_microseconds();
+    printf("gbk_to_utf8 %zu bytes x 20: %" PRIu64 "us, iconv: %" PRIu64 "us\n", gbk.size(), middle-begin, end-middle);
+}
+
+int main()
+{
+    if (!test_mixed())
+        return 1;
+    if (!test_error())
+        return 1;
+    if (!test_buffer())
+        return 1;
+    if (!test_thread())
+        return 1;
+    if (!test_utf16())
+    {
+        printf("utf16 mismatch\n");
+        return 1;
+    }
+    if (!test_gbk_table())
+        return 1;
+
+    bench();
+    printf("charset utils ok\n");
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "mooon/utils/codec.h"
+#include "mooon/utils/crypto.h"
+#include "mooon/utils/string_utils.h"
+#include <stdlib.h>
+UTILS_NAMESPACE_USE
+
+static std::string random_bytes(size_t size)
+{
+    std::string bytes(size, '\0');
+    for (size_t i=0; i<size; ++i)
+        bytes[i] = static_cast<char>(random());
+    return bytes;
+}
+
+// RFC 4648的测试向量
+static bool test_base64_vectors()
+{
+    const char* vectors[][2] = {
+        { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" }
+    };
+
+    for (size_t i=0; i<sizeof(vectors)/sizeof(vectors[0]); ++i)
+    {
+        std::string decoded;
+        if ((CCodec::base64_encode(vectors[i][0]) != vectors[i][1])
+         || !CCodec::base64_decode(vectors[i][1], &decoded) || (decoded != vectors[i][0]))
+        {
+            printf("vector %zu failed\n", i);
+            return false;
+        }
+    }
+
+    // 不带填充也可解码，无效输入返回失败
+    std::string decoded;
+    if (!CCodec::base64_decode("Zm9vYg", &decoded) || (decoded != "foob"))
+        return false;
+    return !CCodec::base64_decode("Zm9v!mFy", &decoded) && !CCodec::base64_decode("Zg==Zg==", &decoded) && !CCodec::base64_decode("Z", &decoded);
+}
+
+// AVX2与标量实现的结果相同，覆盖各种长度的尾部
+static bool test_base64_simd()
+{
+    for (size_t size=0; size<300; ++size)
+    {
+        const std::string bytes = random_bytes(size);
+        CCodec::set_software_only(true);
+        const std::string scalar = CCodec::base64_encode(bytes);
+        CCodec::set_software_only(false);
+        const std::string simd = CCodec::base64_encode(bytes);
+
+        std::string decoded;
+        if ((scalar != simd) || !CCodec::base64_decode(simd, &decoded) || (decoded != bytes))
+        {
+            printf("size %zu failed\n", size);
+            return false;
+        }
+
+        // 无效字符出现在任意位置都能检测到
+        if (simd.size() > 8)
+        {
+            std::string invalid = simd;
+            invalid[size % (simd.size() - 4)] = '*';
+            if (CCodec::base64_decode(invalid, &decoded))
+                return false;
+        }
+    }
+
+    printf("base64 accelerated: %d\n", CCodec::is_accelerated());
+    return true;
+}
+
+// 流式编解码的结果同整体编解码，解码时跳过换行
+static bool test_base64_stream()
+{
+    const std::string bytes = random_bytes(100000);
+    std::string encoded;
+    std::string lines;
+    CBase64Encoder encoder;
+    char out[1024];
+
+    for (size_t i=0; i<bytes.size(); i+=97)
+    {
+        const size_t size = std::min<size_t>(97, bytes.size()-i);
+        encoded.append(out, encoder.update(bytes.data()+i, size, out));
+    }
+    encoded.append(out, encoder.finish(out));
+    if (encoded != CCodec::base64_encode(bytes))
+        return false;
+
+    base64_encode(bytes, &lines, false);
+    CBase64Decoder decoder;
+    std::string decoded;
+    for (size_t i=0; i<lines.size(); i+=101)
+    {
+        const size_t size = std::min<size_t>(101, lines.size()-i);
+        const ssize_t n = decoder.update(lines.data()+i, size, out);
+        if (n < 0)
+            return false;
+        decoded.append(out, n);
+    }
+    const ssize_t n = decoder.finish(out);
+    if ((n < 0) || (decoded.append(out, n) != bytes))
+        return false;
+
+    std::string crypto_decoded;
+    base64_decode(lines, &crypto_decoded, false);
+    return (crypto_decoded == bytes) && (decoder.update("QQ", 2, out) < 0);
+}
+
+static bool test_hex()
+{
+    for (size_t size=0; size<100; ++size)
+    {
+        const std::string bytes = random_bytes(size);
+        std::string hex = CStringUtils::to_hex(bytes, (size % 2) == 0);
+        std::string decoded(size, '\0');
+        if (CCodec::hex_decode(hex.data(), hex.size(), &decoded[0]) != static_cast<ssize_t>(size) || (decoded != bytes))
+            return false;
+
+        if (size > 0)
+        {
+            hex[size] = 'g';
+            if (CCodec::hex_decode(hex.data(), hex.size(), &decoded[0]) != -1)
+                return false;
+        }
+    }
+
+    char out[4];
+    return -1 == CCodec::hex_decode("abc", 3, out);
+}
+
+static bool test_url()
+{
+    const std::string url("a b&c=d/~_-.中");
+    if (CStringUtils::encode_url(url) != "a%20b%26c%3Dd%2F~_-.%E4%B8%AD")
+        return false;
+    if (CStringUtils::encode_url(url, true) != "a+b%26c%3Dd%2F~_-.%E4%B8%AD")
+        return false;
+
+    // %后不是两个十六进制字符时原样保留，可含结尾符
+    const std::string encoded("a%zz%4");
+    return (CStringUtils::decode_url(CStringUtils::encode_url(url)) == url) && (CStringUtils::decode_url("a+b%41%") == "a bA%")
+        && (CStringUtils::decode_url(encoded) == encoded) && (CStringUtils::decode_url(std::string("a%00b", 5)) == std::string("a\0b", 3));
+}
+
+int main()
+{
+    if (!test_base64_vectors())
+        return 1;
+    if (!test_base64_simd())
+        return 1;
+    if (!test_base64_stream())
+        return 1;
+    if (!test_hex())
+        return 1;
+    if (!test_url())
+        return 1;
+
+    printf("codec ok\n");
+    return 0;
+}
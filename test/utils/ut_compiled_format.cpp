@@ -0,0 +1,99 @@
+#include "mooon/utils/compiled_format.h"
+#include "mooon/utils/string_formatter.h"
+#include "mooon/utils/string_utils.h"
+#include "mooon/sys/datetime_utils.h"
+using namespace mooon;
+using namespace mooon::utils;
+
+static bool check(const std::string& result, const std::string& expected)
+{
+    if (result != expected)
+    {
+        printf("mismatch: [%s] expected [%s]\n", result.c_str(), expected.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 结果与snprintf相同
+static bool test_printf_compatible()
+{
+    std::string name("mooon");
+    char expected[256];
+
+    snprintf(expected, sizeof(expected), "%s:%d|%u|%x|%08.3f|%-6s|%5d|%c|%%|%.2e|%lld", name.c_str(), -123, 456u, 255, 3.14159, "ab", 42, 'z', 12345.678, -9000000000LL);
+    if (!check(CCompiledFormat("%s:%d|%u|%x|%08.3f|%-6s|%5d|%c|%%|%.2e|%lld").format_string(name, -123, 456u, 255, 3.14159, "ab", 42, 'z', 12345.678, -9000000000LL), expected))
+        return false;
+
+    snprintf(expected, sizeof(expected), "[%*d][%.*s][%+d][%#o][%zu][%g]", 6, 7, 3, "abcdef", 5, 8, static_cast<size_t>(99), 0.5);
+    if (!check(format_string("[%*d][%.*s][%+d][%#o][%zu][%g]", 6, 7, 3, "abcdef", 5, 8, static_cast<size_t>(99), 0.5), expected))
+        return false;
+
+    // 长结果
+    std::string long_str(5000, 'x');
+    return check(format_string("<%s>", long_str), "<" + long_str + ">");
+}
+
+// 按参数的实际类型格式化，参数不足时忽略多出的转换符
+static bool test_type_safe()
+{
+    if (!check(format_string("%d %s %s %d", std::string("str"), 123, 0.1, 'a'), "str 123 0.1 97"))
+        return false;
+    if (!check(format_string("a=%d b=%d", 1), "a=1 b="))
+        return false;
+    return check(MOOON_FORMAT_STRING("%s:%u", "127.0.0.1", static_cast<uint16_t>(8080)), "127.0.0.1:8080") && check(MOOON_FORMAT_STRING("plain"), "plain");
+}
+
+static bool test_buffer_reuse()
+{
+    CFormatBuffer buffer;
+    for (int i=0; i<3; ++i)
+    {
+        buffer.clear();
+        MOOON_FORMAT_TO(&buffer, "%d-%s", i, "x");
+    }
+    if (0 != strcmp(buffer.c_str(), "2-x"))
+        return false;
+
+    StringFormatter formatter("%s|%d", "abc", 123);
+    StringFormatter long_formatter("%s", std::string(1000, 'y').c_str());
+    return (0 == strcmp(formatter.c_str(), "abc|123")) && (1000 == strlen(long_formatter.c_str()))
+        && (CStringUtils::format_string("%s", std::string(5000, 'z').c_str()).size() == 5000)
+        && (CStringUtils::any2string(0.1) == "0.1") && (CStringUtils::any2string("s") == "s");
+}
+
+static void benchmark()
+{
+    const int loops = 200000;
+    const std::string name("request");
+    uint64_t start = sys::CDatetimeUtils::get_current_microseconds();
+    size_t total = 0;
+    for (int i=0; i<loops; ++i)
+        total += CStringUtils::format_string("%s id=%d cost=%uus", name.c_str(), i, 12345u).size();
+    uint64_t middle = sys::CDatetimeUtils::get_current_microseconds();
+
+    static const CCompiledFormat compiled_format("%s id=%d cost=%uus");
+    CFormatBuffer buffer;
+    for (int i=0; i<loops; ++i)
+    {
+        buffer.clear();
+        compiled_format.format_to(&buffer, name, i, 12345u);
+        total += buffer.size();
+    }
+    uint64_t end = sys::CDatetimeUtils::get_current_microseconds();
+    printf("format_string: %" PRIu64 "us, compiled: %" PRIu64 "us (%zu)\n", middle - start, end - middle, total);
+}
+
+int main()
+{
+    if (!test_printf_compatible())
+        return 1;
+    if (!test_type_safe())
+        return 1;
+    if (!test_buffer_reuse())
+        return 1;
+
+    benchmark();
+    printf("compiled format ok\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include "mooon/net/io_buffer.h"
+#include "mooon/utils/compressor.h"
+#include "mooon/utils/exception.h"
+#include "mooon/utils/string_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+using namespace mooon;
+
+// 有重复的文本，类似日志
+static std::string make_text(size_t size)
+{
+    std::string text;
+    for (int i=0; text.size()<size; ++i)
+        text += utils::CStringUtils::format_string("[2024-01-01 12:00:00][INFO][handler.cpp:%d] request %d done, cost %dus\n", i % 100, i, rand() % 1000);
+    text.resize(size);
+    return text;
+}
+
+// 分多次输入，在任意位置切分压缩数据解压
+static bool test_stream(utils::compression_t compression)
+{
+    const std::string text = make_text(300000);
+    utils::CCompressor compressor(compression);
+    std::string compressed;
+    for (size_t offset=0; offset<text.size(); offset+=7777)
+        compressor.compress(text.data() + offset, std::min<size_t>(7777, text.size() - offset), &compressed);
+    compressor.finish(&compressed);
+
+    std::string decompressed;
+    bool finished = false;
+    utils::CDecompressor decompressor(compression);
+    for (size_t offset=0; offset<compressed.size(); offset+=333)
+        finished = decompressor.decompress(compressed.data() + offset, std::min<size_t>(333, compressed.size() - offset), &decompressed);
+    printf("%s: %zu -> %zu bytes\n", utils::get_compression_name(compression), text.size(), compressed.size());
+    if (!finished || (decompressed != text))
+        return false;
+    if ((compression != utils::compression_none) && (compressed.size() * 3 > text.size()))
+        return false;
+
+    // 复用上下文压缩下一个流，两个流拼接后也能连续解出
+    compressor.reset();
+    std::string second;
+    compressor.compress("hello", 5, &second);
+    compressor.finish(&second);
+    decompressed.clear();
+    decompressor.reset();
+    const std::string concatenated = compressed + second;
+    return decompressor.decompress(concatenated.data(), concatenated.size(), &decompressed) && (decompressed == text + "hello");
+}
+
+// flush后接收方能解出已输入的全部数据
+static bool test_flush(utils::compression_t compression)
+{
+    utils::CCompressor compressor(compression);
+    utils::CDecompressor decompressor(compression);
+    std::string decompressed;
+    for (int i=0; i<3; ++i)
+    {
+        std::string compressed;
+        const std::string message = utils::CStringUtils::format_string("message %d;", i);
+        compressor.compress(message.data(), message.size(), &compressed);
+        compressor.flush(&compressed);
+        if (decompressor.decompress(compressed.data(), compressed.size(), &decompressed))
+            return false; // 流还未结束
+        if (decompressed.size() != 10 * static_cast<size_t>(i + 1))
+            return false;
+    }
+    return decompressed == "message 0;message 1;message 2;";
+}
+
+static bool test_corrupted()
+{
+    std::string compressed;
+    const std::string text = make_text(10000);
+    utils::compress_data(utils::compression_gzip, text.data(), text.size(), &compressed);
+
+    std::string decompressed;
+    try
+    {
+        // 截断的
+        utils::decompress_data(utils::compression_gzip, compressed.data(), compressed.size() - 10, &decompressed);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+    if (!decompressed.empty())
+        return false;
+
+    try
+    {
+        compressed[compressed.size() / 2] ^= 0x55;
+        compressed[compressed.size() / 2 + 1] ^= 0x55;
+        utils::decompress_data(utils::compression_gzip, compressed.data(), compressed.size(), &decompressed);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+    return decompressed.empty();
+}
+
+// 字典使小数据也能压缩
+static bool test_dictionary()
+{
+    const std::string dictionary = "{\"user_id\":,\"action\":\"click\",\"page\":\"/index.html\",\"timestamp\":}";
+    const std::string message = "{\"user_id\":12345,\"action\":\"click\",\"page\":\"/index.html\",\"timestamp\":1700000000}";
+    std::string plain, with_dictionary, decompressed;
+
+    utils::compress_data(utils::compression_zlib, message.data(), message.size(), &plain);
+    utils::CCompressor compressor(utils::compression_zlib, -1, dictionary);
+    compressor.compress(message.data(), message.size(), &with_dictionary);
+    compressor.finish(&with_dictionary);
+    printf("dictionary: %zu -> %zu (%zu without dictionary)\n", message.size(), with_dictionary.size(), plain.size());
+    if (with_dictionary.size() >= plain.size())
+        return false;
+
+    utils::CDecompressor decompressor(utils::compression_zlib, dictionary);
+    if (!decompressor.decompress(with_dictionary.data(), with_dictionary.size(), &decompressed) || (decompressed != message))
+        return false;
+
+    // 没有字典不能解
+    try
+    {
+        decompressed.clear();
+        utils::decompress_data(utils::compression_zlib, with_dictionary.data(), with_dictionary.size(), &decompressed);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+
+    // gzip格式不支持字典
+    try
+    {
+        utils::CCompressor gzip(utils::compression_gzip, -1, dictionary);
+        return false;
+    }
+    catch (utils::CException& ex)
+    {
+        printf("expected: %s\n", ex.str().c_str());
+    }
+    return true;
+}
+
+// 直接压缩CIoBuffer的各个片段
+static bool test_io_buffer()
+{
+    const std::string text = make_text(100000);
+    net::CIoBuffer in(4096), compressed(4096), out(4096);
+    in.append(text.data(), text.size());
+    if (in.get_slice_number() < 2)
+        return false;
+
+    utils::CCompressor::get_thread_compressor(utils::compression_gzip)->compress_buffer(in, true, &compressed);
+    if (!utils::CDecompressor::get_thread_decompressor(utils::compression_gzip)->decompress_buffer(compressed, &out))
+        return false;
+
+    std::string data(out.size(), '\0');
+    return out.copy_out(&data[0], 0, data.size()) && (data == text);
+}
+
+int main()
+{
+    for (int i=utils::compression_none; i<utils::compression_max; ++i)
+    {
+        const utils::compression_t compression = static_cast<utils::compression_t>(i);
+        if (!utils::is_compression_supported(compression))
+        {
+            // 未找到库的不能创建
+            try
+            {
+                utils::CCompressor compressor(compression);
+                return 1;
+            }
+            catch (utils::CException& ex)
+            {
+                printf("expected: %s\n", ex.str().c_str());
+                continue;
+            }
+        }
+        if (!test_stream(compression))
+            return 1;
+        if ((compression != utils::compression_none) && !test_flush(compression))
+            return 1;
+        if (utils::get_compression_by_name(utils::get_compression_name(compression)) != compression)
+            return 1;
+    }
+
+    std::string compressed;
+    utils::compress_data(utils::compression_gzip, "x", 1, &compressed);
+    if ((utils::compression_gzip != utils::detect_compression(compressed.data(), compressed.size()))
+     || (utils::compression_none != utils::detect_compression("\x0c\xb1", 2)))
+        return 1;
+
+    if (!test_corrupted())
+        return 1;
+    if (!test_dictionary())
+        return 1;
+    if (!test_io_buffer())
+        return 1;
+
+    printf("compressor ok\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "mooon/utils/crc32.h"
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <zlib.h>
+UTILS_NAMESPACE_USE
+
+// 已知的校验值
+static bool test_check_values()
+{
+    const char* str = "123456789";
+    if ((CCrc32::crc32(str, 9) != 0xCBF43926) || (CCrc32::crc32c(str, 9) != 0xE3069283))
+    {
+        printf("check value mismatch: %08x %08x\n", CCrc32::crc32(str, 9), CCrc32::crc32c(str, 9));
+        return false;
+    }
+    return (0 == CCrc32::crc32(str, 0)) && (0 == CCrc32::crc32c(str, 0));
+}
+
+// 各种长度和对齐偏移下，与zlib及软件实现的结果一致，分段流式计算结果也一致
+static bool test_lengths(const std::string& data)
+{
+    for (size_t offset=0; offset<8; ++offset)
+    {
+        for (size_t size=0; size+offset<=data.size(); size+=(size<300)? 1: 997)
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data()) + offset;
+            const uint32_t zlib_crc = static_cast<uint32_t>(::crc32(0, bytes, static_cast<uInt>(size)));
+
+            CCrc32::set_software_only(false);
+            const uint32_t crc = CCrc32::crc32(bytes, size);
+            const uint32_t crcc = CCrc32::crc32c(bytes, size);
+            CCrc32::set_software_only(true);
+            const uint32_t software_crc = CCrc32::crc32(bytes, size);
+            const uint32_t software_crcc = CCrc32::crc32c(bytes, size);
+            CCrc32::set_software_only(false);
+
+            CCrc32 stream(CCrc32::poly_castagnoli);
+            stream.update(bytes, size/3);
+            stream.update(bytes+size/3, size-size/3);
+            if ((crc != zlib_crc) || (software_crc != zlib_crc) || (crcc != software_crcc) || (stream.get_value() != crcc))
+            {
+                printf("mismatch: offset=%zu, size=%zu\n", offset, size);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static double measure(CCrc32::polynomial_t polynomial, const std::string& data)
+{
+    struct timespec begin, end;
+    uint32_t crc = 0;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i=0; i<20; ++i)
+        crc = CCrc32::checksum(polynomial, data.data(), data.size(), crc);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+    return (20.0 * data.size() / (1024*1024)) / seconds;
+}
+
+int main()
+{
+    std::string data(1024*1024, '\0');
+    for (size_t i=0; i<data.size(); ++i)
+        data[i] = static_cast<char>(random());
+
+    if (!test_check_values())
+        return 1;
+    if (!test_lengths(data))
+        return 1;
+
+    printf("crc32 hardware=%d: %.0f MB/s\n", CCrc32::is_hardware_accelerated(CCrc32::poly_ieee), measure(CCrc32::poly_ieee, data));
+    printf("crc32c hardware=%d: %.0f MB/s\n", CCrc32::is_hardware_accelerated(CCrc32::poly_castagnoli), measure(CCrc32::poly_castagnoli, data));
+    CCrc32::set_software_only(true);
+    printf("crc32 slice-by-8: %.0f MB/s\n", measure(CCrc32::poly_ieee, data));
+    printf("crc32c slice-by-8: %.0f MB/s\n", measure(CCrc32::poly_castagnoli, data));
+
+    printf("crc32 ok\n");
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "mooon/utils/flat_hash_map.h"
+#include "mooon/utils/tokener.h"
+#include <map>
+#include <string>
+UTILS_NAMESPACE_USE
+
+// 与std::map对照的随机插入、查找和删除，覆盖删除标记的复用和重建
+static bool test_map_against_std()
+{
+    CFlatHashMap<uint64_t, uint64_t> flat_map;
+    std::map<uint64_t, uint64_t> std_map;
+    uint64_t seed = 1;
+
+    for (int i=0; i<200000; ++i)
+    {
+        seed = CHashUtils::mix64(seed);
+        const uint64_t key = seed % 5000;
+        if (seed & 0x100)
+        {
+            flat_map[key] = seed;
+            std_map[key] = seed;
+        }
+        else if (flat_map.erase(key) != std_map.erase(key))
+        {
+            printf("erase mismatch: %" PRIu64 "\n", key);
+            return false;
+        }
+    }
+
+    if (flat_map.size() != std_map.size())
+        return false;
+    for (std::map<uint64_t, uint64_t>::const_iterator iter=std_map.begin(); iter!=std_map.end(); ++iter)
+    {
+        CFlatHashMap<uint64_t, uint64_t>::const_iterator found = flat_map.find(iter->first);
+        if ((found == flat_map.end()) || (found->second != iter->second))
+            return false;
+    }
+
+    size_t count = 0;
+    for (CFlatHashMap<uint64_t, uint64_t>::iterator iter=flat_map.begin(); iter!=flat_map.end(); ++iter)
+        ++count;
+    printf("map: size=%zu, capacity=%zu\n", flat_map.size(), flat_map.capacity());
+    return (count == std_map.size()) && (flat_map.count(5001) == 0);
+}
+
+static bool test_string_map()
+{
+    CFlatHashMap<std::string, std::string> map;
+    if (!map.insert("a", "1").second || map.insert("a", "2").second || (map["a"] != "1"))
+        return false;
+
+    for (int i=0; i<1000; ++i)
+        map[CStringUtils::int_tostring(i)] = CStringUtils::int_tostring(i*2);
+
+    // 复制后相互独立
+    CFlatHashMap<std::string, std::string> copy(map);
+    map.erase("10");
+    map.clear();
+    if (!map.empty() || (map.find("1") != map.end()) || (copy.size() != 1001) || (copy["10"] != "20"))
+        return false;
+
+    CFlatHashMap<std::string, std::string>::iterator iter = copy.find("a");
+    copy.erase(iter);
+    return (copy.size() == 1000) && (0 == copy.count("a"));
+}
+
+static bool test_set()
+{
+    CFlatHashSet<int> set;
+    set.reserve(100);
+    const size_t capacity = set.capacity();
+    for (int i=0; i<100; ++i)
+        set.insert(i * 7);
+    return (set.size() == 100) && (set.capacity() == capacity) && (1 == set.count(693)) && (0 == set.count(694));
+}
+
+static bool test_enhanced_tokener()
+{
+    CEnhancedTokener tokener;
+    tokener.parse("n1=v1&n2=va2&n3&n1=v4", "&", '=');
+    if ((tokener["n1"] != "v4") || (tokener["n2"] != "va2") || !tokener.exist("n3") || tokener.exist("n4"))
+        return false;
+    if ((tokener.flat_tokens().size() != 3) || (CStringUtils::map2string(tokener.tokens(), "&") != "v4&va2&"))
+        return false;
+    if (CStringUtils::map2string(tokener.flat_tokens(), "&").size() != 7)
+        return false;
+
+    tokener.parse("n0=v0", "&");
+    return (tokener.tokens().size() == 4) && (tokener.tokens().begin()->first == "n0");
+}
+
+int main()
+{
+    if (!test_map_against_std())
+        return 1;
+    if (!test_string_map())
+        return 1;
+    if (!test_set())
+        return 1;
+    if (!test_enhanced_tokener())
+        return 1;
+
+    printf("flat hash map ok\n");
+    return 0;
+}
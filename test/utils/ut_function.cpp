@@ -0,0 +1,170 @@
+#include "mooon/sys/task_executor.h"
+#include "mooon/sys/thread_engine.h"
+#include "mooon/utils/bind.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+using namespace mooon;
+
+// 统计operator new的次数，以验证绑定和提交任务时不从堆上分配
+static uint64_t sg_new_number = 0;
+
+void* operator new(size_t size)
+{
+    __atomic_add_fetch(&sg_new_number, 1, __ATOMIC_RELAXED);
+    void* memory = malloc((0 == size)? 1: size);
+    if (NULL == memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+static uint64_t get_new_number()
+{
+    return __atomic_load_n(&sg_new_number, __ATOMIC_RELAXED);
+}
+
+static int sg_sum = 0;
+
+static void add(int m)
+{
+    __atomic_add_fetch(&sg_sum, m, __ATOMIC_RELAXED);
+}
+
+static void add9(int a, int b, int c, int d, int e, int f, int g, int h, int i)
+{
+    sg_sum += a + b + c + d + e + f + g + h + i;
+}
+
+static int get_length(std::string str)
+{
+    return static_cast<int>(str.size());
+}
+
+class X
+{
+public:
+    X(): _sum(0) {}
+    void add(int m, int n) { _sum += m + n; }
+    int get_sum() { return _sum; }
+
+private:
+    int _sum;
+};
+
+static bool test_utils_functor()
+{
+    X x;
+    const uint64_t new_number = get_new_number();
+
+    utils::Functor<void> f1 = utils::bind<void>(&add, 1);
+    utils::Functor<void> f2 = utils::bind<void>(&X::add, &x, 2, 3);
+    if (!f1.is_inline() || !f2.is_inline())
+        return false;
+
+    // 转移后原来的为空，内联的函数对象被移动到新的Functor中
+    utils::Functor<void> f3(static_cast<utils::Functor<void>&&>(f1));
+    utils::Functor<void> f4 = f2;
+    if (!f1.empty() || !f2.empty() || f3.empty() || !f3.is_inline())
+        return false;
+    f3();
+    f4();
+    if ((sg_sum != 1) || (x.get_sum() != 5) || (get_new_number() != new_number))
+        return false;
+
+    // 赋值时销毁原来的
+    f3 = utils::bind<void>(&add, 10);
+    f3();
+    if (sg_sum != 11)
+        return false;
+
+    // 有返回值，参数的移动不丢失值
+    utils::Functor<int> f5 = utils::bind<int>(&get_length, std::string(100, 'x'));
+    utils::Functor<int> f6 = f5;
+    if (f6() != 100)
+        return false;
+    utils::Functor<int> f7 = utils::bind<int>(&X::get_sum, &x);
+    return f7() == 5;
+}
+
+static bool test_sys_functor()
+{
+    const uint64_t new_number = get_new_number();
+    sys::Functor f1 = sys::bind(&add, 100);
+    sys::Functor f2 = f1;
+    if (!f1.empty() || !f2.is_inline() || (get_new_number() != new_number))
+        return false;
+    f2();
+
+    // 超过内联大小的从堆上分配
+    sys::Functor f3 = sys::bind(&add9, 1, 2, 3, 4, 5, 6, 7, 8, 9);
+    sys::Functor f4 = f3;
+    if (f4.is_inline() || (get_new_number() != new_number + 1))
+        return false;
+    f4();
+
+    sg_sum = 0;
+    sys::CThreadEngine engine(sys::bind(&add, 7));
+    engine.join();
+    return 7 == sg_sum;
+}
+
+static bool test_executor()
+{
+    sys::CTaskExecutor executor;
+    sys::CTaskFuture future;
+    executor.create(1);
+
+    // 先预热，使任务对象和队列都已分配
+    sg_sum = 0;
+    for (int i=0; i<10; ++i)
+    {
+        future.reset();
+        executor.submit(utils::bind<void>(&add, 1), &future);
+        future.wait();
+    }
+
+    const uint64_t new_number = get_new_number();
+    for (int i=0; i<1000; ++i)
+    {
+        future.reset();
+        executor.submit(utils::bind<void>(&add, 1), &future);
+        future.wait();
+    }
+    const uint64_t submit_new_number = get_new_number() - new_number;
+    printf("new number of 1000 submissions: %u\n", static_cast<unsigned int>(submit_new_number));
+
+    executor.destroy();
+    return (1010 == sg_sum) && (submit_new_number < 10);
+}
+
+int main()
+{
+    if (!test_utils_functor())
+    {
+        printf("test_utils_functor failed\n");
+        return 1;
+    }
+    if (!test_sys_functor())
+    {
+        printf("test_sys_functor failed\n");
+        return 1;
+    }
+    if (!test_executor())
+    {
+        printf("test_executor failed\n");
+        return 1;
+    }
+
+    printf("function ok\n");
+    return 0;
+}
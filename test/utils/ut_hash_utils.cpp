@@ -0,0 +1,142 @@
+#include "mooon/utils/hash_utils.h"
+#include <map>
+#include <string>
+UTILS_NAMESPACE_USE
+
+static bool test_xxhash64()
+{
+    // 官方实现的结果
+    if ((CHashUtils::xxhash64("", 0) != 0xEF46DB3751D8E999ULL) || (CHashUtils::xxhash64("abc", 3) != 0x44BC2CF5AD770999ULL))
+        return false;
+    if (CHashUtils::xxhash64<123>("abc", 3) != CHashUtils::xxhash64("abc", 3, 123))
+        return false;
+
+    CXXHash64Hasher<> hasher;
+    return hasher(std::string("abc")) == static_cast<size_t>(0x44BC2CF5AD770999ULL);
+}
+
+// 桶从n增加到n+1时，移动的键都移到新桶，比例约为1/(n+1)
+static bool test_jump_consistent_hash()
+{
+    const int keys = 100000;
+    for (int32_t n=1; n<20; ++n)
+    {
+        int moved = 0;
+        for (int i=0; i<keys; ++i)
+        {
+            const uint64_t key = CHashUtils::mix64(i);
+            const int32_t old_bucket = CHashUtils::jump_consistent_hash(key, n);
+            const int32_t new_bucket = CHashUtils::jump_consistent_hash(key, n+1);
+            if ((old_bucket < 0) || (old_bucket >= n))
+                return false;
+            if (old_bucket != new_bucket)
+            {
+                if (new_bucket != n)
+                    return false;
+                ++moved;
+            }
+        }
+
+        const double expected = static_cast<double>(keys) / (n+1);
+        if ((moved < expected*0.9) || (moved > expected*1.1))
+        {
+            printf("jump %d: moved %d, expected %.0f\n", n, moved, expected);
+            return false;
+        }
+    }
+
+    return -1 == CHashUtils::jump_consistent_hash(1, 0);
+}
+
+// 删除一个节点时，只有原属于它的键移动
+static bool test_rendezvous_hash()
+{
+    std::vector<uint64_t> nodes;
+    for (int i=0; i<10; ++i)
+    {
+        char name[32];
+        nodes.push_back(CHashUtils::xxhash64(name, snprintf(name, sizeof(name), "node%d", i)));
+    }
+
+    std::vector<uint64_t> removed = nodes;
+    removed.erase(removed.begin() + 3);
+    std::vector<int> counts(nodes.size());
+    for (int i=0; i<100000; ++i)
+    {
+        const uint64_t key = CHashUtils::mix64(i);
+        const int before = CHashUtils::rendezvous_hash(key, nodes);
+        const int after = CHashUtils::rendezvous_hash(key, removed);
+        ++counts[before];
+        if ((before != 3) && (removed[after] != nodes[before]))
+            return false;
+    }
+    for (size_t i=0; i<counts.size(); ++i)
+    {
+        if ((counts[i] < 9000) || (counts[i] > 11000))
+            return false;
+    }
+
+    // 权重为3:1
+    std::vector<uint64_t> two_nodes(nodes.begin(), nodes.begin()+2);
+    std::vector<double> weights;
+    weights.push_back(3);
+    weights.push_back(1);
+    int first = 0;
+    for (int i=0; i<100000; ++i)
+        first += (0 == CHashUtils::weighted_rendezvous_hash(CHashUtils::mix64(i), two_nodes, weights));
+    printf("weighted rendezvous: %d/100000\n", first);
+    return (first > 73000) && (first < 77000) && (-1 == CHashUtils::rendezvous_hash(1, std::vector<uint64_t>()));
+}
+
+static bool test_consistent_hash()
+{
+    CConsistentHash ring;
+    if (!ring.get_node(1).empty())
+        return false;
+    for (int i=0; i<8; ++i)
+        ring.add_node(std::string("10.0.0.") + static_cast<char>('1'+i) + ":6379");
+
+    std::map<uint64_t, std::string> before;
+    std::map<std::string, int> counts;
+    for (int i=0; i<80000; ++i)
+    {
+        const uint64_t key = CHashUtils::mix64(i);
+        before[key] = ring.get_node(key);
+        ++counts[before[key]];
+    }
+    for (std::map<std::string, int>::const_iterator iter=counts.begin(); iter!=counts.end(); ++iter)
+    {
+        if ((iter->second < 8000) || (iter->second > 12000))
+        {
+            printf("consistent hash %s: %d\n", iter->first.c_str(), iter->second);
+            return false;
+        }
+    }
+
+    ring.remove_node("10.0.0.4:6379");
+    for (std::map<uint64_t, std::string>::const_iterator iter=before.begin(); iter!=before.end(); ++iter)
+    {
+        const std::string& node = ring.get_node(iter->first);
+        if ((iter->second != "10.0.0.4:6379") && (node != iter->second))
+            return false;
+        if (node == "10.0.0.4:6379")
+            return false;
+    }
+
+    return 7 == ring.get_nodes().size();
+}
+
+int main()
+{
+    if (!test_xxhash64())
+        return 1;
+    if (!test_jump_consistent_hash())
+        return 1;
+    if (!test_rendezvous_hash())
+        return 1;
+    if (!test_consistent_hash())
+        return 1;
+
+    printf("hash utils ok\n");
+    return 0;
+}
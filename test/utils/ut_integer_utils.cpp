@@ -0,0 +1,160 @@
+#include "mooon/utils/integer_utils.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+using namespace mooon;
+
+static bool test_varint()
+{
+    const uint64_t values[] = { 0, 1, 127, 128, 300, 16383, 16384, UINT64_C(0xFFFFFFFF), UINT64_C(0xFFFFFFFFFFFFFFFF) };
+    char buffer[10];
+    for (size_t i=0; i<sizeof(values)/sizeof(values[0]); ++i)
+    {
+        uint64_t value;
+        const size_t size = utils::CIntegerUtils::encode_varint(values[i], buffer);
+        if ((size != utils::CIntegerUtils::get_varint_size(values[i]))
+         || (size != utils::CIntegerUtils::decode_varint(buffer, size, &value))
+         || (value != values[i]))
+        {
+            printf("varint %" PRIu64" failed\n", values[i]);
+            return false;
+        }
+        // 不完整的
+        if (0 != utils::CIntegerUtils::decode_varint(buffer, size - 1, &value))
+            return false;
+    }
+
+    // 超过uint32_t的不能解为uint32_t
+    uint32_t value32;
+    const size_t size = utils::CIntegerUtils::encode_varint(UINT64_C(0x100000000), buffer);
+    if (0 != utils::CIntegerUtils::decode_varint(buffer, size, &value32))
+        return false;
+
+    return (0 == utils::CIntegerUtils::zigzag_encode(0))
+        && (1 == utils::CIntegerUtils::zigzag_encode(-1))
+        && (2 == utils::CIntegerUtils::zigzag_encode(1))
+        && (-2 == utils::CIntegerUtils::zigzag_decode(utils::CIntegerUtils::zigzag_encode(-2)))
+        && (INT32_MIN == utils::CIntegerUtils::zigzag_decode(utils::CIntegerUtils::zigzag_encode(INT32_MIN)))
+        && (INT64_MIN == utils::CIntegerUtils::zigzag_decode(utils::CIntegerUtils::zigzag_encode(INT64_MIN)))
+        && (INT64_MAX == utils::CIntegerUtils::zigzag_decode(utils::CIntegerUtils::zigzag_encode(INT64_MAX)));
+}
+
+// 所有位数的打包和解包
+static bool test_pack()
+{
+    uint32_t values[128], unpacked[128];
+    uint64_t values64[128], unpacked64[128];
+    char buffer[64 * 16];
+
+    for (uint32_t bits=0; bits<=64; ++bits)
+    {
+        for (int i=0; i<128; ++i)
+        {
+            const uint64_t number = (static_cast<uint64_t>(random()) << 33) ^ (static_cast<uint64_t>(random()) << 11) ^ random();
+            values64[i] = (0 == bits)? 0: ((64 == bits)? number: number & ((UINT64_C(1) << bits) - 1));
+            values[i] = static_cast<uint32_t>(values64[i]);
+        }
+        if (bits <= 32)
+        {
+            utils::CIntegerUtils::pack128(values, bits, buffer);
+            utils::CIntegerUtils::unpack128(buffer, bits, unpacked);
+            for (int i=0; i<128; ++i)
+            {
+                if (values[i] != unpacked[i])
+                {
+                    printf("pack128 bits=%u index=%d failed\n", bits, i);
+                    return false;
+                }
+            }
+        }
+
+        utils::CIntegerUtils::pack128(values64, bits, buffer);
+        utils::CIntegerUtils::unpack128(buffer, bits, unpacked64);
+        for (int i=0; i<128; ++i)
+        {
+            if (values64[i] != unpacked64[i])
+            {
+                printf("pack128 64 bits=%u index=%d failed\n", bits, i);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename T>
+static bool check_compress(const std::vector<T>& values, utils::integer_codec_t codec, const char* name)
+{
+    std::vector<char> buffer(utils::CIntegerUtils::get_max_compressed_size(values.size(), sizeof(T)));
+    const size_t size = utils::CIntegerUtils::compress(values.data(), values.size(), buffer.data(), codec);
+    if (size > buffer.size())
+        return false;
+
+    std::vector<T> decompressed(1, 0); // 追加到已有的后面
+    if ((size != utils::CIntegerUtils::decompress(buffer.data(), size, &decompressed))
+     || (decompressed.size() != values.size() + 1)
+     || !std::equal(values.begin(), values.end(), decompressed.begin() + 1))
+    {
+        printf("%s codec=%d failed\n", name, codec);
+        return false;
+    }
+    // 截断的数据不能解压，原有的不变
+    if ((size > 2) && ((0 != utils::CIntegerUtils::decompress(buffer.data(), size - 1, &decompressed)) || (decompressed.size() != values.size() + 1)))
+    {
+        printf("%s codec=%d truncated not detected\n", name, codec);
+        return false;
+    }
+
+    printf("%s codec=%d: %zu values, %zu bytes\n", name, codec, values.size(), size);
+    return true;
+}
+
+static bool test_compress()
+{
+    const utils::integer_codec_t codecs[] = { utils::integer_codec_varint, utils::integer_codec_for, utils::integer_codec_delta };
+    std::vector<uint32_t> sorted, clustered, random32;
+    std::vector<uint64_t> timestamps;
+    uint32_t id = 1000000;
+    for (int i=0; i<1000; ++i)
+    {
+        id += random() % 16;
+        sorted.push_back(id);
+        clustered.push_back(3000000000u + random() % 1000);
+        random32.push_back(static_cast<uint32_t>(random()) * 2);
+        timestamps.push_back(UINT64_C(1700000000000000) + i * 1000 + random() % 10);
+    }
+
+    for (size_t i=0; i<sizeof(codecs)/sizeof(codecs[0]); ++i)
+    {
+        if (!check_compress(std::vector<uint32_t>(), codecs[i], "empty")
+         || !check_compress(std::vector<uint32_t>(sorted.begin(), sorted.begin() + 100), codecs[i], "tail")
+         || !check_compress(sorted, codecs[i], "sorted")
+         || !check_compress(clustered, codecs[i], "clustered")
+         || !check_compress(random32, codecs[i], "random")
+         || !check_compress(timestamps, codecs[i], "timestamps"))
+            return false;
+    }
+
+    // 有序的ID用delta打包后每个不到1字节
+    std::vector<char> buffer(utils::CIntegerUtils::get_max_compressed_size(sorted.size(), sizeof(uint32_t)));
+    if (utils::CIntegerUtils::compress(sorted.data(), sorted.size(), buffer.data(), utils::integer_codec_delta) >= sorted.size())
+        return false;
+
+    // 错误的方式
+    std::vector<uint32_t> values;
+    const char corrupted[] = { 9, 1, 1 };
+    return (0 == utils::CIntegerUtils::decompress(corrupted, sizeof(corrupted), &values)) && values.empty();
+}
+
+int main()
+{
+    if (!test_varint())
+        return 1;
+    if (!test_pack())
+        return 1;
+    if (!test_compress())
+        return 1;
+
+    printf("integer utils ok\n");
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "mooon/utils/json_writer.h"
+#include <limits>
+#include <list>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+UTILS_NAMESPACE_USE
+
+#define EXPECT(actual, expected) \
+    do { \
+        const std::string a = (actual); \
+        if (a != (expected)) { printf("line %d: %s != %s\n", __LINE__, a.c_str(), std::string(expected).c_str()); return false; } \
+    } while (0)
+
+// 只用于测试的链式缓冲区，记录append的次数
+struct FakeIoBuffer
+{
+    std::string data;
+    int append_number;
+
+    FakeIoBuffer(): append_number(0) {}
+    void append(const char* str, size_t size) { data.append(str, size); ++append_number; }
+};
+
+static bool test_structure()
+{
+    std::string json;
+    {
+        CJsonWriter writer(&json);
+        writer.begin_object();
+        writer.key("name").value("mooon");
+        writer.key("ports").begin_array().value(2015).value(2016).end_array();
+        writer.key("empty").begin_object().end_object();
+        writer.key("list").begin_array().begin_array().end_array().null_value().value(true).value(false).end_array();
+        writer.key("raw").raw_value("{\"a\":1}", 7);
+        writer.end_object();
+        if (writer.get_depth() != 0)
+            return false;
+    }
+    EXPECT(json, "{\"name\":\"mooon\",\"ports\":[2015,2016],\"empty\":{},\"list\":[[],null,true,false],\"raw\":{\"a\":1}}");
+
+    // 追加到已有内容之后
+    {
+        CJsonWriter writer(&json);
+        writer.value(1);
+    }
+    EXPECT(json.substr(json.size()-2), "}1");
+    return true;
+}
+
+static bool test_escape()
+{
+    std::string out;
+    static const char str[] = "a\"b\\c\nd\te\x01\x1f\xe4\xb8\xad/";
+    CJsonWriter::escape(str, sizeof(str)-1, &out);
+    EXPECT(out, "a\\\"b\\\\c\\nd\\te\\u0001\\u001f\xe4\xb8\xad/");
+
+    // 长字符串跨越向量宽度和写者缓冲区的边界，与逐字节的转义结果逐一对比
+    for (size_t size=0; size<10000; size+=(size<100)? 1: 997)
+    {
+        std::string str(size, '\0');
+        std::string expected = "\"";
+        for (size_t i=0; i<size; ++i)
+        {
+            const int r = random() % 64;
+            str[i] = (0 == r)? '"': ((1 == r)? '\\': ((2 == r)? static_cast<char>(random() % 32): static_cast<char>('a' + r % 26)));
+
+            const unsigned char c = static_cast<unsigned char>(str[i]);
+            char buffer[8];
+            if (('"' == c) || ('\\' == c)) { expected.push_back('\\'); expected.push_back(c); }
+            else if ('\n' == c) expected += "\\n";
+            else if ('\r' == c) expected += "\\r";
+            else if ('\t' == c) expected += "\\t";
+            else if ('\b' == c) expected += "\\b";
+            else if ('\f' == c) expected += "\\f";
+            else if (c < 0x20) { snprintf(buffer, sizeof(buffer), "\\u%04x", c); expected += buffer; }
+            else expected.push_back(c);
+        }
+        expected.push_back('"');
+
+        std::string json;
+        {
+            CJsonWriter writer(&json);
+            writer.value(str);
+        }
+        if (json != expected)
+        {
+            printf("escape mismatch: size=%zu\n", size);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_numbers()
+{
+    char buffer[24];
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(static_cast<uint64_t>(0), buffer)), "0");
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(static_cast<uint64_t>(9), buffer)), "9");
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(static_cast<uint64_t>(10), buffer)), "10");
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(static_cast<uint64_t>(12345), buffer)), "12345");
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(std::numeric_limits<uint64_t>::max(), buffer)), "18446744073709551615");
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(std::numeric_limits<int64_t>::min(), buffer)), "-9223372036854775808");
+    EXPECT(std::string(buffer, CJsonWriter::format_integer(static_cast<int64_t>(-7), buffer)), "-7");
+
+    for (int i=0; i<100000; ++i)
+    {
+        const int64_t n = (static_cast<int64_t>(random()) << 32 | random()) >> (random() % 63);
+        char expected[24];
+        snprintf(expected, sizeof(expected), "%" PRId64, n);
+        if (std::string(buffer, CJsonWriter::format_integer(n, buffer)) != expected)
+        {
+            printf("integer mismatch: %s\n", expected);
+            return false;
+        }
+    }
+
+    // 浮点数须能精确还原，不能表示的为null
+    std::string json;
+    {
+        CJsonWriter writer(&json);
+        writer.begin_array().value(0.1).value(-2.5).value(1e300).value(std::numeric_limits<double>::quiet_NaN())
+              .value(std::numeric_limits<double>::infinity()).end_array();
+    }
+    const char* p = json.c_str() + 1;
+    char* end = NULL;
+    if ((strtod(p, &end) != 0.1) || (*end != ',')
+     || (strtod(end+1, &end) != -2.5) || (*end != ',')
+     || (strtod(end+1, &end) != 1e300) || (strcmp(end, ",null,null]") != 0))
+    {
+        printf("double mismatch: %s\n", json.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool test_sink_and_helpers()
+{
+    FakeIoBuffer io_buffer;
+    CIoBufferJsonSink<FakeIoBuffer> sink(&io_buffer);
+    std::string expected = "[";
+    {
+        CJsonWriter writer(&sink);
+        writer.begin_array();
+        for (int i=0; i<10000; ++i)
+        {
+            writer.value(i);
+            expected += (i > 0)? ",": "";
+            char buffer[16];
+            expected += std::string(buffer, snprintf(buffer, sizeof(buffer), "%d", i));
+        }
+        writer.end_array();
+    }
+    expected += "]";
+    EXPECT(io_buffer.data, expected);
+    if (io_buffer.append_number < 2) // 缓冲区满时交给sink
+        return false;
+
+    std::list<std::string> names;
+    names.push_back("a");
+    names.push_back("b\"");
+    EXPECT(container2json(names), "[\"a\",\"b\\\"\"]");
+
+    std::map<int, std::vector<int> > map;
+    map[2].push_back(1);
+    map[2].push_back(2);
+    map[1];
+    EXPECT(map2json(map), "{\"1\":[],\"2\":[1,2]}");
+
+    std::map<std::string, std::map<std::string, double> > nested;
+    nested["x"]["y"] = 0.5;
+    EXPECT(map2json(nested), "{\"x\":{\"y\":0.5}}");
+    return true;
+}
+
+int main()
+{
+    if (!test_structure() || !test_escape() || !test_numbers() || !test_sink_and_helpers())
+        return 1;
+
+    printf("json writer ok\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "mooon/sys/file_utils.h"
+#include "mooon/utils/md5_helper.h"
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <vector>
+using namespace mooon;
+using namespace mooon::utils;
+
+static std::string digest2string(const unsigned char digest[16])
+{
+    char str[33];
+    for (int i=0; i<16; ++i)
+        snprintf(str+i*2, 3, "%02x", digest[i]);
+    return str;
+}
+
+// RFC 1321中的测试值，取值后可继续update
+static bool test_streaming()
+{
+    if ((CMd5Helper::lowercase_md5("%s", "") != "d41d8cd98f00b204e9800998ecf8427e")
+     || (CMd5Helper::lowercase_md5("%s", "abc") != "900150983cd24fb0d6963f7d28e17f72"))
+        return false;
+
+    CMd5Helper md5;
+    md5.update("message ", 8);
+    if (md5.low_8bytes() != md5.low_8bytes())
+        return false;
+    struct iovec iov[2] = { { const_cast<char*>("dig"), 3 }, { const_cast<char*>("est"), 3 } };
+    md5.update(iov, 2);
+    if ((md5.to_string(false) != "f96b697d7cb7938d525a2f31aaf161d0") || (md5.to_string() != "F96B697D7CB7938D525A2F31AAF161D0"))
+        return false;
+
+    md5.reset();
+    md5.update("abc", 3);
+    return md5.to_string(false) == "900150983cd24fb0d6963f7d28e17f72";
+}
+
+// 多缓冲结果与逐个计算一致，消息长度各不相同，覆盖填充跨块的情况
+static bool test_multi_digest()
+{
+    std::vector<std::string> keys;
+    for (size_t i=0; i<1000; ++i)
+    {
+        std::string key((i * 37) % 300, '\0');
+        for (size_t j=0; j<key.size(); ++j)
+            key[j] = static_cast<char>(random());
+        keys.push_back(key);
+    }
+
+    for (size_t count=0; count<=keys.size(); count+=(count<20)? 1: 331)
+    {
+        std::vector<struct iovec> messages(count + 1);
+        std::vector<unsigned char> digests((count + 1) * 16);
+        for (size_t i=0; i<count; ++i)
+        {
+            messages[i].iov_base = const_cast<char*>(keys[i].data());
+            messages[i].iov_len = keys[i].size();
+        }
+
+        CMd5Helper::multi_digest(&messages[0], count, reinterpret_cast<unsigned char (*)[16]>(&digests[0]));
+        for (size_t i=0; i<count; ++i)
+        {
+            unsigned char expected[16];
+            CMd5Helper::digest(keys[i].data(), keys[i].size(), expected);
+            if (0 != memcmp(expected, &digests[i*16], 16))
+            {
+                printf("multi_digest mismatch: count=%zu, index=%zu, size=%zu\n", count, i, keys[i].size());
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static double elapsed_seconds(const struct timespec& begin)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+}
+
+static void benchmark_short_keys()
+{
+    const size_t count = 200000;
+    std::vector<std::string> keys(count);
+    std::vector<struct iovec> messages(count);
+    std::vector<unsigned char> digests(count * 16);
+    for (size_t i=0; i<count; ++i)
+    {
+        char key[32];
+        keys[i].assign(key, snprintf(key, sizeof(key), "user:%zu", i * 7919));
+        messages[i].iov_base = const_cast<char*>(keys[i].data());
+        messages[i].iov_len = keys[i].size();
+    }
+
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (size_t i=0; i<count; ++i)
+        CMd5Helper::digest(keys[i].data(), keys[i].size(), &digests[i*16]);
+    const double serial_seconds = elapsed_seconds(begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    CMd5Helper::multi_digest(&messages[0], count, reinterpret_cast<unsigned char (*)[16]>(&digests[0]));
+    const double multi_seconds = elapsed_seconds(begin);
+    printf("%zu short keys: serial %.3fs, multi_digest(avx2=%d) %.3fs\n",
+           count, serial_seconds, CMd5Helper::is_multi_buffer_accelerated(), multi_seconds);
+}
+
+// 树形MD5与线程数无关，单块时等于对块MD5再求MD5
+static bool test_tree_md5sum()
+{
+    char path[] = "/tmp/ut_md5_helper.XXXXXX";
+    int fd = mkstemp(path);
+    if (-1 == fd)
+        return false;
+    unlink(path);
+
+    std::string data(3*1024*1024 + 123, '\0');
+    for (size_t i=0; i<data.size(); ++i)
+        data[i] = static_cast<char>(i % 251);
+    if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+        return false;
+
+    std::string md5_str, tree1, tree4, single;
+    (void)lseek(fd, 0, SEEK_SET);
+    sys::CFileUtils::md5sum(&md5_str, fd);
+    sys::CFileUtils::tree_md5sum(&tree1, fd, 1024*1024, 1);
+    sys::CFileUtils::tree_md5sum(&tree4, fd, 1024*1024, 4);
+    sys::CFileUtils::tree_md5sum(&single, fd, data.size(), 3);
+    close(fd);
+
+    unsigned char digest[16];
+    CMd5Helper::digest(data.data(), data.size(), digest);
+    CMd5Helper md5;
+    md5.update(reinterpret_cast<const char*>(digest), sizeof(digest));
+    printf("md5sum %s, tree %s\n", md5_str.c_str(), tree4.c_str());
+    return (CStringUtils::to_upper(digest2string(digest)) == md5_str)
+        && (tree1 == tree4) && (tree1 != md5_str) && (single == md5.to_string());
+}
+
+int main()
+{
+    try
+    {
+        if (!test_streaming())
+        {
+            printf("streaming mismatch\n");
+            return 1;
+        }
+        if (!test_multi_digest())
+            return 1;
+        if (!test_tree_md5sum())
+            return 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "main exception: %s at %s:%d.\n", ex.str().c_str(), ex.file(), ex.line());
+        return 1;
+    }
+
+    benchmark_short_keys();
+    printf("md5 helper ok\n");
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "mooon/utils/mpsc_list_queue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <vector>
+UTILS_NAMESPACE_USE
+
+#define LOOP_NUMBER     200000 // 每个生产者插入的元素个数
+#define PRODUCER_NUMBER 4
+
+class CNode: public CListable<CNode>
+{
+public:
+    CNode(): producer(-1), sequence(0) {}
+    int producer;
+    int sequence;
+};
+
+static CMpscListQueue<CNode> mpsc_queue;
+static std::vector<CNode> nodes(LOOP_NUMBER * PRODUCER_NUMBER);
+static volatile int wakeup_number = 0;
+
+static void* producer(void* param)
+{
+    const int index = static_cast<int>(reinterpret_cast<long>(param));
+    for (int i=0; i<LOOP_NUMBER; ++i)
+    {
+        CNode* node = &nodes[index*LOOP_NUMBER + i];
+        node->producer = index;
+        node->sequence = i;
+        if (mpsc_queue.push(node))
+            __sync_fetch_and_add(&wakeup_number, 1);
+    }
+
+    return NULL;
+}
+
+// 单线程下的顺序和批量入队
+static bool test_single()
+{
+    CMpscListQueue<CNode> queue;
+    CNode chain[5];
+    if ((queue.pop() != NULL) || !queue.is_empty())
+        return false;
+    if (!queue.push(&chain[0]) || queue.push(&chain[1]))
+        return false;
+
+    // 一串对象一次入队
+    chain[2].set_next(&chain[3]);
+    chain[3].set_next(&chain[4]);
+    (void)queue.push(&chain[2], &chain[4], 3);
+    if (queue.get_number() != 5)
+        return false;
+
+    CNode* array[8];
+    if ((queue.pop() != &chain[0]) || (2 != queue.pop_batch(array, 2)) || (array[0] != &chain[1]) || (array[1] != &chain[2]))
+        return false;
+    if ((2 != queue.pop_batch(array, 8)) || (array[1] != &chain[4]) || !queue.is_empty() || (queue.pop() != NULL))
+        return false;
+
+    // 出队的可以再次入队
+    return queue.push(&chain[0]) && (queue.pop() == &chain[0]) && (NULL == chain[0].get_next());
+}
+
+int main()
+{
+    if (!test_single())
+    {
+        printf("single FAILURE\n");
+        return 1;
+    }
+
+    pthread_t producers[PRODUCER_NUMBER];
+    for (long i=0; i<PRODUCER_NUMBER; ++i)
+        pthread_create(&producers[i], NULL, producer, reinterpret_cast<void*>(i));
+
+    // 每个生产者的对象应按入队顺序出队
+    int next_sequence[PRODUCER_NUMBER] = { 0 };
+    int consumed_number = 0;
+    int retry_number = 0;
+    CNode* array[64];
+    while (consumed_number < LOOP_NUMBER*PRODUCER_NUMBER)
+    {
+        const int number = mpsc_queue.pop_batch(array, 64);
+        if (0 == number)
+        {
+            ++retry_number;
+            sched_yield();
+            continue;
+        }
+
+        for (int i=0; i<number; ++i)
+        {
+            CNode* node = array[i];
+            if (node->sequence != next_sequence[node->producer]++)
+            {
+                printf("order FAILURE: producer %d, sequence %d\n", node->producer, node->sequence);
+                return 1;
+            }
+        }
+        consumed_number += number;
+    }
+
+    for (int i=0; i<PRODUCER_NUMBER; ++i)
+        pthread_join(producers[i], NULL);
+
+    printf("consumed: %d, wakeup: %d, retry: %d, empty: %s\n", consumed_number, wakeup_number, retry_number, mpsc_queue.is_empty()? "true": "false");
+    if (!mpsc_queue.is_empty() || (mpsc_queue.pop() != NULL) || (wakeup_number < 1))
+        return 1;
+
+    printf("mpsc list queue ok\n");
+    return 0;
+}
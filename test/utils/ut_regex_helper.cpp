@@ -0,0 +1,175 @@
+#include "mooon/utils/regex_helper.h"
+#include "mooon/utils/string_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+UTILS_NAMESPACE_USE
+
+static int check_literal(const char* pattern, const char* expected, int cflags=REG_EXTENDED)
+{
+    const std::string literal = CRegexSet::extract_literal(pattern, cflags, regex_posix);
+    if (literal != expected)
+    {
+        printf("literal of `%s`: `%s`, expected `%s`\n", pattern, literal.c_str(), expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    // 单个模式和分组偏移
+    CRegexHelper kv("([a-z]+)=([0-9]+)(x)?");
+    std::vector<regex_capture_t> captures;
+    const char* line = "key=123;";
+    if (!kv.match(line, 7, &captures) || (captures.size() != 4) ||
+        (captures[0] != regex_capture_t(0, 7)) || (captures[1] != regex_capture_t(0, 3)) ||
+        (captures[2] != regex_capture_t(4, 7)) || (captures[3] != regex_capture_t(-1, -1)))
+        return 1;
+    if (kv.match("key=;", 5, NULL) || !kv.match("a=1", 3, NULL))
+        return 1;
+
+    // 只匹配前size个字节
+    if (kv.match("key=123", 4, NULL))
+        return 1;
+
+    // 缓存
+    const CRegexHelper* cached = CRegexHelper::get_cached("^[0-9]+$");
+    if ((cached != CRegexHelper::get_cached("^[0-9]+$")) || (cached == CRegexHelper::get_cached("^[0-9]+$", REG_EXTENDED|REG_NOSUB)))
+        return 1;
+    if (!cached->match("2024", 0) || cached->match("20a4", 0))
+        return 1;
+    try
+    {
+        CRegexHelper::get_cached("(");
+        return 1;
+    }
+    catch (CException& ex)
+    {
+        printf("%s\n", ex.str().c_str());
+    }
+
+    // 字面量提取
+    if (check_literal("foo[0-9]+bar", "foo") || check_literal("ab*cd", "cd") || check_literal("x|y", "") ||
+        check_literal("error: (disk|net) full", "error: ") || check_literal("\\.conf$", ".conf") ||
+        check_literal("colou?r", "colo") || check_literal("a{2}bc", "bc") || check_literal("[]abc]+defg", "defg") ||
+        check_literal("[[:alpha:]x]+k", "k") || check_literal("Timeout\\b", "timeout") || check_literal("foo", "", 0) ||
+        check_literal("ab+c", "ab") || check_literal("(a|b)", ""))
+        return 1;
+    if (CRegexSet::extract_literal("(?i)abc", REG_EXTENDED, regex_pcre2) != "")
+        return 1;
+
+    // 多模式：结果须和逐个匹配相同
+    CRegexSet rules;
+    std::vector<CRegexHelper*> helpers;
+    const char* words[] = { "disk", "net", "timeout", "error", "full", "conn", "retry", "user", "ok", "fail" };
+    const int word_number = sizeof(words) / sizeof(words[0]);
+    for (int i=0; i<300; ++i)
+    {
+        std::string pattern;
+        int cflags = REG_EXTENDED;
+        switch (i % 5)
+        {
+        case 0: pattern = CStringUtils::format_string("%s [0-9]+ %s", words[i%word_number], words[(i/5)%word_number]); break;
+        case 1: pattern = CStringUtils::format_string("^%s(%s|%s)", words[i%word_number], words[(i/3)%word_number], words[(i/7)%word_number]); break;
+        case 2: pattern = CStringUtils::format_string("%s|%s=[a-z]", words[i%word_number], words[(i/11)%word_number]); break;
+        case 3: pattern = CStringUtils::format_string("%s.*%c%s", words[i%word_number], 'a'+i%26, words[(i/13)%word_number]); cflags |= REG_ICASE; break;
+        default: pattern = CStringUtils::format_string("([a-z]+)=%d", i); break;
+        }
+        if (rules.add(pattern, cflags) != i)
+            return 1;
+        helpers.push_back(new CRegexHelper(pattern.c_str(), cflags));
+    }
+    rules.compile();
+
+    int always = 0;
+    for (size_t i=0; i<rules.get_pattern_number(); ++i)
+    {
+        if (rules.get_literal(static_cast<int>(i)).empty())
+            ++always;
+    }
+    printf("patterns: %d, without literal: %d\n", static_cast<int>(rules.get_pattern_number()), always);
+
+    srandom(2024);
+    int total = 0;
+    for (int n=0; n<2000; ++n)
+    {
+        std::string text;
+        for (int k=random()%8; k>=0; --k)
+        {
+            switch (random() % 4)
+            {
+            case 0: text += words[random() % word_number]; break;
+            case 1: text += CStringUtils::format_string(" %d ", static_cast<int>(random() % 400)); break;
+            case 2: text += CStringUtils::format_string("%c", static_cast<char>('A' + random() % 26)); break;
+            default: text += CStringUtils::format_string("k=%d", static_cast<int>(random() % 300)); break;
+            }
+        }
+
+        std::vector<int> expected;
+        for (size_t i=0; i<helpers.size(); ++i)
+        {
+            if (helpers[i]->match(text.data(), text.size(), NULL))
+                expected.push_back(static_cast<int>(i));
+        }
+
+        std::vector<int> ids;
+        std::vector<regex_match_t> matches;
+        if ((rules.match(text, &ids) != static_cast<int>(expected.size())) || (ids != expected))
+        {
+            printf("mismatch: %s\n", text.c_str());
+            return 1;
+        }
+        if ((rules.match(text, &matches) != static_cast<int>(expected.size())))
+            return 1;
+        for (size_t i=0; i<matches.size(); ++i)
+        {
+            std::vector<regex_capture_t> expected_captures;
+            helpers[matches[i].id]->match(text.data(), text.size(), &expected_captures);
+            if ((matches[i].id != expected[i]) || (matches[i].captures != expected_captures))
+                return 1;
+        }
+        if (rules.match_first(text.data(), text.size()) != (expected.empty()? -1: expected[0]))
+            return 1;
+        total += static_cast<int>(expected.size());
+    }
+    printf("matched: %d\n", total);
+
+    // 大小写
+    CRegexSet icase;
+    icase.add("DISK full", REG_EXTENDED|REG_ICASE);
+    icase.add("DISK full");
+    icase.compile();
+    std::vector<int> ids;
+    if ((icase.match(std::string("disk FULL"), &ids) != 1) || (ids[0] != 0))
+        return 1;
+    if (icase.match(std::string("DISK full"), &ids) != 2)
+        return 1;
+
+    // 未编译和不支持的实现
+    CRegexSet empty;
+    try
+    {
+        empty.match(std::string("x"), &ids);
+        return 1;
+    }
+    catch (CException&)
+    {
+    }
+    if (!is_regex_backend_supported(regex_pcre2))
+    {
+        try
+        {
+            CRegexSet pcre(regex_pcre2);
+            return 1;
+        }
+        catch (CException& ex)
+        {
+            printf("%s\n", ex.str().c_str());
+        }
+    }
+
+    for (size_t i=0; i<helpers.size(); ++i)
+        delete helpers[i];
+    printf("ok\n");
+    return 0;
+}
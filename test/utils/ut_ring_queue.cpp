@@ -0,0 +1,82 @@
+#include "mooon/utils/ring_queue.h"
+#include <pthread.h>
+UTILS_NAMESPACE_USE
+
+#define LOOP_NUMBER   1000000 // 每个生产者插入的元素个数
+#define PRODUCER_NUMBER 4
+#define CONSUMER_NUMBER 4
+
+static CMpmcRingQueue<uint64_t> mpmc_queue(1024);
+static volatile uint64_t consumed_sum = 0;
+static volatile int consumed_number = 0;
+
+static void* producer(void* param)
+{
+    for (uint64_t i=1; i<=LOOP_NUMBER; ++i)
+    {
+        while (!mpmc_queue.try_push(i));
+    }
+
+    return NULL;
+}
+
+static void* consumer(void* param)
+{
+    uint64_t sum = 0;
+    uint64_t elem = 0;
+
+    while (__sync_fetch_and_add(&consumed_number, 0) < LOOP_NUMBER*PRODUCER_NUMBER)
+    {
+        if (mpmc_queue.try_pop(elem))
+        {
+            sum += elem;
+            __sync_fetch_and_add(&consumed_number, 1);
+        }
+    }
+
+    __sync_fetch_and_add(&consumed_sum, sum);
+    return NULL;
+}
+
+int main()
+{
+    // 测试SPSC
+    printf("\n>>>>>>>>>>TEST CSpscRingQueue<<<<<<<<<<\n\n");
+    CSpscRingQueue<int> spsc_queue(5);
+    printf("capacity: %u (expected 8)\n", spsc_queue.capacity());
+
+    for (int i=0; !spsc_queue.is_full(); ++i)
+        spsc_queue.push_back(i);
+    printf("size: %u, try_push: %s (expected false)\n", spsc_queue.size(), spsc_queue.try_push(100)? "true": "false");
+
+    int m = 0;
+    while (spsc_queue.try_pop(m))
+        printf("%d ", m);
+    printf("\nis_empty: %s\n", spsc_queue.is_empty()? "true": "false");
+
+    // 测试MPMC
+    printf("\n>>>>>>>>>>TEST CMpmcRingQueue<<<<<<<<<<\n\n");
+    pthread_t producers[PRODUCER_NUMBER];
+    pthread_t consumers[CONSUMER_NUMBER];
+
+    for (int i=0; i<CONSUMER_NUMBER; ++i)
+        pthread_create(&consumers[i], NULL, consumer, NULL);
+    for (int i=0; i<PRODUCER_NUMBER; ++i)
+        pthread_create(&producers[i], NULL, producer, NULL);
+    for (int i=0; i<PRODUCER_NUMBER; ++i)
+        pthread_join(producers[i], NULL);
+    for (int i=0; i<CONSUMER_NUMBER; ++i)
+        pthread_join(consumers[i], NULL);
+
+    const uint64_t expected_sum = (uint64_t)PRODUCER_NUMBER * LOOP_NUMBER * (LOOP_NUMBER+1) / 2;
+    if (consumed_sum == expected_sum)
+    {
+        printf("MPMC OK: sum=%" PRIu64"\n", consumed_sum);
+        return 0;
+    }
+    else
+    {
+        printf("MPMC ERROR: sum=%" PRIu64", expected=%" PRIu64"\n", consumed_sum, expected_sum);
+        return 1;
+    }
+}
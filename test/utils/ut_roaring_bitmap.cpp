@@ -0,0 +1,124 @@
+#include "mooon/utils/roaring_bitmap.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iterator>
+#include <set>
+UTILS_NAMESPACE_USE
+
+static bool equals(const CRoaringBitmap& bitmap, const std::set<uint32_t>& reference)
+{
+    std::vector<uint32_t> values;
+    bitmap.to_vector(&values);
+    return (bitmap.size() == reference.size()) && std::equal(values.begin(), values.end(), reference.begin()) && (values.size() == reference.size());
+}
+
+// 生成同时有稀疏容器和密集容器的集合
+static void random_fill(CRoaringBitmap* bitmap, std::set<uint32_t>* reference, uint32_t dense_key)
+{
+    for (int i=0; i<20000; ++i)
+    {
+        const uint32_t value = static_cast<uint32_t>(random()) % (UINT32_C(1) << 22);
+        (void)bitmap->add(value);
+        reference->insert(value);
+    }
+    for (int i=0; i<30000; ++i)
+    {
+        const uint32_t value = (dense_key << 16) | static_cast<uint32_t>(random() % 65536);
+        (void)bitmap->add(value);
+        reference->insert(value);
+    }
+}
+
+static bool test_basic()
+{
+    CRoaringBitmap bitmap;
+    if (!bitmap.add(5) || bitmap.add(5) || !bitmap.add(UINT32_C(0xFFFFFFFF)) || !bitmap.contains(5) || bitmap.contains(6))
+        return false;
+    if (!bitmap.remove(5) || bitmap.remove(5) || (1 != bitmap.size()))
+        return false;
+
+    // 超过4096个元素时转成位图容器，删除到4096个时转回数组，内容不变
+    std::set<uint32_t> reference;
+    reference.insert(UINT32_C(0xFFFFFFFF));
+    for (uint32_t i=0; i<5000; ++i)
+    {
+        (void)bitmap.add(i * 3);
+        reference.insert(i * 3);
+    }
+    const size_t bitmap_size = bitmap.get_memory_size();
+    for (uint32_t i=0; i<1000; ++i)
+    {
+        (void)bitmap.remove(i * 3);
+        reference.erase(i * 3);
+    }
+    printf("basic: memory %zu -> %zu\n", bitmap_size, bitmap.get_memory_size());
+    if (!equals(bitmap, reference) || (bitmap.get_memory_size() >= bitmap_size))
+        return false;
+
+    // 跨容器的范围
+    bitmap.clear();
+    reference.clear();
+    bitmap.add_range(65530, 200000);
+    for (uint32_t i=65530; i<200000; ++i)
+        reference.insert(i);
+    (void)bitmap.add(7);
+    reference.insert(7);
+    return equals(bitmap, reference) && !bitmap.contains(200000) && bitmap.contains(131072);
+}
+
+static bool test_operations()
+{
+    CRoaringBitmap a, b;
+    std::set<uint32_t> ra, rb;
+    random_fill(&a, &ra, 3);
+    random_fill(&b, &rb, 3);
+    b.add_range(UINT32_C(5) << 16, UINT32_C(6) << 16);
+    for (uint32_t i=UINT32_C(5) << 16; i<(UINT32_C(6) << 16); ++i)
+        rb.insert(i);
+
+    std::set<uint32_t> r_and, r_or, r_and_not;
+    std::set_intersection(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(r_and, r_and.begin()));
+    std::set_union(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(r_or, r_or.begin()));
+    std::set_difference(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(r_and_not, r_and_not.begin()));
+
+    CRoaringBitmap x = a; x &= b;
+    CRoaringBitmap y = a; y |= b;
+    CRoaringBitmap z = a; z.and_not(b);
+    printf("operations: and=%zu, or=%zu, and_not=%zu, and_count=%" PRIu64"\n", r_and.size(), r_or.size(), r_and_not.size(), a.and_count(b));
+    if (!equals(x, r_and) || !equals(y, r_or) || !equals(z, r_and_not) || (r_and.size() != a.and_count(b)))
+        return false;
+
+    // 运算后容器的形式只由元素决定
+    CRoaringBitmap rebuilt;
+    for (std::set<uint32_t>::const_iterator iter=r_or.begin(); iter!=r_or.end(); ++iter)
+        (void)rebuilt.add(*iter);
+    if ((rebuilt != y) || !(x == x))
+        return false;
+
+    CBitmap bitmap(UINT32_C(1) << 22);
+    y.to_bitmap(&bitmap);
+    size_t count = 0;
+    for (std::set<uint32_t>::const_iterator iter=r_or.begin(); iter!=r_or.end(); ++iter)
+    {
+        if (*iter < bitmap.size())
+        {
+            if (!bitmap.test(*iter))
+                return false;
+            ++count;
+        }
+    }
+    return count == bitmap.count();
+}
+
+int main()
+{
+    if (!test_basic())
+        return 1;
+    if (!test_operations())
+        return 1;
+
+    printf("roaring bitmap ok\n");
+    return 0;
+}
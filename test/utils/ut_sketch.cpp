@@ -0,0 +1,112 @@
+#include "mooon/sys/mmap.h"
+#include "mooon/utils/sketch.h"
+#include "mooon/utils/string_utils.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+UTILS_NAMESPACE_USE
+
+// 估计值不小于真实值，偏大不超过总次数的epsilon倍
+static bool test_count_min()
+{
+    const double epsilon = 0.001;
+    CCountMinSketch sketch(epsilon, 0.01);
+    std::vector<uint32_t> counts(2000);
+    for (int i=1; i<2000; ++i)
+    {
+        counts[i] = 10000 / i; // 长尾分布，少数键很热
+        sketch.add(CStringUtils::int_tostring(i), counts[i]);
+    }
+
+    int overestimated = 0;
+    const uint64_t total = sketch.get_total();
+    for (int i=1; i<2000; ++i)
+    {
+        const uint32_t estimate = sketch.estimate(CStringUtils::int_tostring(i));
+        if (estimate < counts[i])
+            return false;
+        overestimated += (estimate > counts[i] + epsilon * total)? 1: 0;
+    }
+    printf("count-min: %ux%u, total=%" PRIu64", %d overestimated\n", sketch.get_width(), sketch.get_depth(), total, overestimated);
+    if ((overestimated > 20) || (10000 != sketch.estimate("1")))
+        return false;
+
+    CCountMinSketch other(epsilon, 0.01);
+    other.add("1", 100);
+    if (!sketch.merge(other) || (10100 != sketch.estimate("1")))
+        return false;
+    sketch.halve();
+    return (5050 == sketch.estimate("1")) && (total / 2 + 50 == sketch.get_total()) && !sketch.merge(CCountMinSketch(0.1, 0.01));
+}
+
+static bool test_hyperloglog()
+{
+    CHyperLogLog small(14);
+    for (int i=0; i<100; ++i)
+    {
+        small.add(CStringUtils::int_tostring(i));
+        small.add(CStringUtils::int_tostring(i)); // 重复的不计
+    }
+    printf("hyperloglog: 100 -> %" PRIu64"\n", small.estimate());
+    if ((small.estimate() < 98) || (small.estimate() > 102))
+        return false;
+
+    CHyperLogLog a(14), b(14);
+    for (int i=0; i<1000000; ++i)
+    {
+        const std::string key = CStringUtils::int_tostring(i);
+        ((i < 600000)? a: b).add(key);
+        if ((i >= 400000) && (i < 600000))
+            b.add(key); // 两者有200000个相同的
+    }
+    const uint64_t estimate_a = a.estimate();
+    if (!a.merge(b))
+        return false;
+    printf("hyperloglog: 600000 -> %" PRIu64", union 1000000 -> %" PRIu64"\n", estimate_a, a.estimate());
+    return (estimate_a > 582000) && (estimate_a < 618000) && (a.estimate() > 970000) && (a.estimate() < 1030000) && !a.merge(CHyperLogLog(10));
+}
+
+// 写入文件后mmap并attach，修改直接写入文件
+static bool test_mmap()
+{
+    const char* filename = "/tmp/ut_sketch.data";
+    CHyperLogLog hll(10);
+    hll.add("a");
+    const std::string data = hll.serialize();
+
+    FILE* fp = fopen(filename, "w");
+    if ((NULL == fp) || (fwrite(data.data(), 1, data.size(), fp) != data.size()))
+        return false;
+    fclose(fp);
+
+    mooon::sys::mmap_t* ptr = mooon::sys::CMMap::map_both(filename);
+    CHyperLogLog mapped;
+    if (!mapped.attach(ptr->addr, ptr->len) || (1 != mapped.estimate()) || (10 != mapped.get_precision()))
+        return false;
+    mapped.add("b");
+    mooon::sys::CMMap::unmap(ptr);
+
+    ptr = mooon::sys::CMMap::map_read(filename);
+    CHyperLogLog reloaded;
+    const bool loaded = reloaded.load(ptr->addr, ptr->len);
+    CCountMinSketch wrong_type;
+    const bool wrong = wrong_type.load(ptr->addr, ptr->len);
+    mooon::sys::CMMap::unmap(ptr);
+    unlink(filename);
+    printf("mmap: reloaded estimate %" PRIu64"\n", reloaded.estimate());
+    return loaded && !wrong && (2 == reloaded.estimate());
+}
+
+int main()
+{
+    if (!test_count_min())
+        return 1;
+    if (!test_hyperloglog())
+        return 1;
+    if (!test_mmap())
+        return 1;
+
+    printf("sketch ok\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "mooon/utils/histogram_array.h"
+#include "mooon/utils/small_vector.h"
+#include <string>
+UTILS_NAMESPACE_USE
+
+static bool test_small_vector()
+{
+    CSmallVector<std::string, 4> vector;
+    for (int i=0; i<4; ++i)
+        vector.push_back(std::string(i+1, 'a'));
+    if (!vector.is_inline() || (vector.size() != 4))
+        return false;
+
+    // 超出内置容量后元素移到堆上，插入vector自身的元素仍有效
+    vector.push_back(vector[0]);
+    if (vector.is_inline() || (vector.size() != 5) || (vector.back() != "a") || (vector[3] != "aaaa"))
+        return false;
+
+    vector.erase(vector.begin()+1);
+    if ((vector.size() != 4) || (vector[1] != "aaa"))
+        return false;
+    vector.insert(vector.begin(), vector[3]);
+    vector.erase(vector.begin());
+    if ((vector.size() != 4) || (vector[0] != "a"))
+        return false;
+
+    CSmallVector<std::string, 4> copy(vector);
+    vector.clear();
+    vector.resize(2);
+    copy.pop_back();
+    return vector[1].empty() && (copy.size() == 3) && (copy.front() == "a") && (copy[2] == "aaaa");
+}
+
+static bool test_histogram_array()
+{
+    CHistogramArray<int> histogram_array(10);
+    if (histogram_array.histogram_exist(3) || (histogram_array.get_histogram(3) != NULL))
+        return false;
+
+    for (int i=0; i<100; ++i)
+        histogram_array.insert(3, i);
+    if (histogram_array.insert(3, 50) || !histogram_array.insert(3, 50, false) || histogram_array.insert(10, 1))
+        return false;
+    if (histogram_array.get_histogram_size(3) != 101)
+        return false;
+
+    // 之前按字节数复制元素，超过一个字节后的元素会丢失
+    const int* histogram = histogram_array.get_histogram(3);
+    for (int i=0; i<100; ++i)
+        if (histogram[i] != i)
+            return false;
+
+    if (!histogram_array.remove(3, 0) || histogram_array.remove(3, 1000) || (histogram_array.get_histogram(3)[0] != 1))
+        return false;
+    for (int i=1; i<100; ++i)
+        histogram_array.remove(3, i);
+    histogram_array.remove(3, 50);
+    return !histogram_array.histogram_exist(3);
+}
+
+// 有序模式下乱序插入，柱内有序，冻结后内容不变且只读
+static bool test_sorted_frozen()
+{
+    CHistogramArray<uint32_t, true> histogram_array(4);
+    for (uint32_t i=0; i<20000; ++i)
+    {
+        histogram_array.insert(i % 4, (i * 7919) % 20000);
+        histogram_array.insert(i % 4, (i * 7919) % 20000);
+    }
+    if ((histogram_array.get_elem_number() != 20000) || !histogram_array.exist(1, 7919) || histogram_array.exist(0, 7919))
+        return false;
+    if (!histogram_array.remove(1, 7919) || histogram_array.remove(1, 7919))
+        return false;
+
+    histogram_array.freeze();
+    if (!histogram_array.is_frozen() || histogram_array.insert(0, 1) || histogram_array.remove(0, 0))
+        return false;
+    if ((histogram_array.get_elem_number() != 19999) || (histogram_array.get_histogram_size(1) != 4999))
+        return false;
+
+    for (uint32_t position=0; position<4; ++position)
+    {
+        const uint32_t* histogram = histogram_array.get_histogram(position);
+        for (uint32_t i=1; i<histogram_array.get_histogram_size(position); ++i)
+            if (histogram[i-1] >= histogram[i])
+                return false;
+    }
+    return histogram_array.exist(2, histogram_array.get_histogram(2)[100]) && !histogram_array.exist(1, 7919);
+}
+
+int main()
+{
+    if (!test_small_vector())
+        return 1;
+    if (!test_histogram_array())
+        return 1;
+    if (!test_sorted_frozen())
+        return 1;
+
+    printf("small vector ok\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "mooon/utils/string_utils.h"
+#include <stdlib.h>
+UTILS_NAMESPACE_USE
+
+template <typename IntType>
+static bool check_parse(const char* str, bool expected_ok, IntType expected_value, uint8_t converted_length=0, bool ignored_zero=false)
+{
+    IntType value = 0;
+    const bool ok = CStringUtils::string2int(str, value, converted_length, ignored_zero);
+    if ((ok != expected_ok) || (ok && (value != expected_value)))
+    {
+        printf("string2int(\"%s\") mismatch: ok=%d\n", str, ok);
+        return false;
+    }
+    return true;
+}
+
+static bool test_parse()
+{
+    return check_parse<int32_t>("123456", true, 123456)
+        && check_parse<int32_t>("-123456", true, -123456)
+        && check_parse<int32_t>("123a456", false, 0)
+        && check_parse<int32_t>("123a456", true, 123, 3)
+        && check_parse<int32_t>("0123456", false, 0)
+        && check_parse<int32_t>("0123456", true, 123456, 0, true)
+        && check_parse<int32_t>("0000000000000000000001", true, 1, 0, true)
+        && check_parse<int32_t>("-0", true, 0)
+        && check_parse<int32_t>("", false, 0)
+        && check_parse<int32_t>("-", false, 0)
+        && check_parse<int32_t>("2147483647", true, 2147483647)
+        && check_parse<int32_t>("2147483648", false, 0)
+        && check_parse<int32_t>("-2147483648", true, std::numeric_limits<int32_t>::min())
+        && check_parse<int32_t>("-2147483649", false, 0)
+        && check_parse<int8_t>("127", true, 127)
+        && check_parse<int8_t>("-128", true, -128)
+        && check_parse<int8_t>("128", false, 0)
+        && check_parse<uint8_t>("255", true, 255)
+        && check_parse<uint8_t>("256", false, 0)
+        && check_parse<uint16_t>("65535", true, 65535)
+        && check_parse<uint32_t>("-1", false, 0)
+        && check_parse<int64_t>("9223372036854775807", true, std::numeric_limits<int64_t>::max())
+        && check_parse<int64_t>("-9223372036854775808", true, std::numeric_limits<int64_t>::min())
+        && check_parse<int64_t>("9223372036854775808", false, 0)
+        && check_parse<uint64_t>("18446744073709551615", true, std::numeric_limits<uint64_t>::max())
+        && check_parse<uint64_t>("18446744073709551616", false, 0)
+        && check_parse<uint64_t>("99999999999999999999", false, 0);
+}
+
+static bool test_format()
+{
+    const int64_t values[] = { 0, 7, -7, 10, 99, -100, 12345, 2147483647, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min() };
+    for (size_t i=0; i<sizeof(values)/sizeof(values[0]); ++i)
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%" PRId64, values[i]);
+        if (CStringUtils::int_tostring(values[i]) != expected)
+        {
+            printf("int_tostring mismatch: %s\n", expected);
+            return false;
+        }
+    }
+
+    if ((CStringUtils::int_tostring(static_cast<int16_t>(-32768)) != "-32768")
+     || (CStringUtils::int_tostring(static_cast<uint32_t>(4294967295U)) != "4294967295")
+     || (CStringUtils::int_tostring(std::numeric_limits<uint64_t>::max()) != "18446744073709551615")
+     || (CStringUtils::any2string(-42) != "-42") || (CStringUtils::any2string('x') != "x"))
+        return false;
+
+    // 最短且能还原
+    if ((CStringUtils::double_tostring(0.1) != "0.1") || (CStringUtils::double_tostring(-2.5) != "-2.5")
+     || (CStringUtils::double_tostring(100) != "100"))
+    {
+        printf("double_tostring: %s\n", CStringUtils::double_tostring(0.1).c_str());
+        return false;
+    }
+
+    srandom(20171012);
+    for (int i=0; i<100000; ++i)
+    {
+        uint64_t bits = (static_cast<uint64_t>(random()) << 33) ^ (static_cast<uint64_t>(random()) << 11) ^ random();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (value != value) // NaN
+            continue;
+
+        double parsed = 0;
+        const std::string str = CStringUtils::double_tostring(value);
+        if (!CStringUtils::string2double(str.c_str(), parsed) || (parsed != value) || (str.size() > 24))
+        {
+            printf("double round trip mismatch: %s\n", str.c_str());
+            return false;
+        }
+    }
+
+    double value;
+    return CStringUtils::string2double(" 1.5", value) && (1.5 == value)
+        && !CStringUtils::string2double("1.5x", value) && (1.5 == value);
+}
+
+int main()
+{
+    if (!test_parse())
+        return 1;
+    if (!test_format())
+        return 1;
+
+    printf("string number ok\n");
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "mooon/utils/string_simd.h"
+#include "mooon/utils/string_utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+UTILS_NAMESPACE_USE
+
+static const char* isa_name(CStringSimd::isa_t isa)
+{
+    return (CStringSimd::isa_avx2 == isa)? "avx2": ((CStringSimd::isa_sse42 == isa)? "sse4.2": "scalar");
+}
+
+// 生成含字母、数字、空白和其它字符的随机字符串
+static std::string random_string(size_t size, const char* alphabet)
+{
+    std::string str(size, '\0');
+    const size_t alphabet_size = strlen(alphabet);
+    for (size_t i=0; i<size; ++i)
+        str[i] = alphabet[random() % alphabet_size];
+    return str;
+}
+
+struct Results
+{
+    std::string upper;
+    std::string lower;
+    std::string hex_lower;
+    std::string hex_upper;
+    size_t leading_spaces;
+    size_t trailing_size;
+    size_t leading_digits;
+    size_t leading_ascii;
+    bool alphabetic;
+    size_t first_of;
+    size_t char_count;
+    std::string escaped;
+    size_t json_escape;
+};
+
+static Results compute(const std::string& str)
+{
+    Results results;
+    results.upper = str;
+    results.lower = str;
+    results.hex_lower.resize(str.size()*2);
+    results.hex_upper.resize(str.size()*2);
+    CStringSimd::to_upper(&results.upper[0], str.size());
+    CStringSimd::to_lower(&results.lower[0], str.size());
+    CStringSimd::to_hex(reinterpret_cast<const unsigned char*>(str.data()), str.size(), &results.hex_lower[0], true);
+    CStringSimd::to_hex(reinterpret_cast<const unsigned char*>(str.data()), str.size(), &results.hex_upper[0], false);
+    results.leading_spaces = CStringSimd::count_leading_spaces(str.data(), str.size());
+    results.trailing_size = CStringSimd::size_without_trailing_spaces(str.data(), str.size());
+    results.leading_digits = CStringSimd::count_leading_digits(str.data(), str.size());
+    results.leading_ascii = CStringSimd::count_leading_ascii(str.data(), str.size());
+    results.alphabetic = CStringSimd::is_alphabetic(str.data(), str.size());
+    results.first_of = CStringSimd::find_first_of(str.data(), str.size(), '\n', '\xff');
+    results.char_count = CStringSimd::count_char(str.data(), str.size(), 'x');
+    results.escaped.resize(str.size()*2);
+    results.escaped.resize(CStringSimd::escape_mysql(str.data(), str.size(), &results.escaped[0]));
+    results.json_escape = CStringSimd::find_json_escape(str.data(), str.size());
+    return results;
+}
+
+static bool equal(const Results& a, const Results& b)
+{
+    return (a.upper == b.upper) && (a.lower == b.lower)
+        && (a.hex_lower == b.hex_lower) && (a.hex_upper == b.hex_upper)
+        && (a.leading_spaces == b.leading_spaces) && (a.trailing_size == b.trailing_size)
+        && (a.leading_digits == b.leading_digits) && (a.leading_ascii == b.leading_ascii) && (a.alphabetic == b.alphabetic)
+        && (a.first_of == b.first_of) && (a.char_count == b.char_count) && (a.escaped == b.escaped)
+        && (a.json_escape == b.json_escape);
+}
+
+// 各指令集的结果与标量实现逐一对比，长度覆盖向量宽度的各种余数
+static bool test_kernels()
+{
+    static const char* alphabets[] =
+    {
+        "aZ@[`{09", " \t\r\n\v\fx", "0123456789", "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ", "\x80\xff\xc1\xe1\xda\xfaMm",
+        "abcdefghijklmnopqrstuvwxyz\n\\'\"\r\032"
+    };
+
+    const CStringSimd::isa_t supported_isa = CStringSimd::get_supported_isa();
+    for (size_t size=0; size<200; ++size)
+    {
+        for (size_t i=0; i<sizeof(alphabets)/sizeof(alphabets[0]); ++i)
+        {
+            std::string str = random_string(size, alphabets[i]);
+            if ((size > 0) && (size % 7 == 0))
+            {
+                str[size/2] = '.'; // 让数字和字母序列中间断开
+                str[size*2/3] = '\xA1'; // 让ASCII序列中间断开
+                str[size/3] = '\0';
+            }
+
+            CStringSimd::set_isa(CStringSimd::isa_scalar);
+            const Results expected = compute(str);
+            for (int isa=CStringSimd::isa_sse42; isa<=supported_isa; ++isa)
+            {
+                CStringSimd::set_isa(static_cast<CStringSimd::isa_t>(isa));
+                if (!equal(compute(str), expected))
+                {
+                    printf("%s mismatch: size=%zu, alphabet=%zu\n", isa_name(static_cast<CStringSimd::isa_t>(isa)), size, i);
+                    return false;
+                }
+            }
+        }
+    }
+
+    CStringSimd::set_isa(supported_isa);
+    return true;
+}
+
+// 在各指令集下与标量实现的结果比较
+static bool check_utf8(const std::string& str, CStringSimd::isa_t supported_isa)
+{
+    CStringSimd::set_isa(CStringSimd::isa_scalar);
+    const size_t expected = CStringSimd::find_invalid_utf8(str.data(), str.size());
+    for (int isa=CStringSimd::isa_sse42; isa<=supported_isa; ++isa)
+    {
+        CStringSimd::set_isa(static_cast<CStringSimd::isa_t>(isa));
+        const size_t offset = CStringSimd::find_invalid_utf8(str.data(), str.size());
+        if (offset != expected)
+        {
+            printf("%s utf-8 mismatch: size=%zu, offset=%zu, expected=%zu\n", isa_name(static_cast<CStringSimd::isa_t>(isa)), str.size(), offset, expected);
+            CStringSimd::set_isa(supported_isa);
+            return false;
+        }
+    }
+
+    CStringSimd::set_isa(supported_isa);
+    return true;
+}
+
+// 所有的1至4字节序列放在不同的位置，以及随机的合法和非法输入
+static bool test_utf8()
+{
+    static const char* valid[] = { "", "abc", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf", "\xee\x80\x80", "\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf", "中文😀" };
+    static const char* invalid[] = { "\x80", "\xc0\xaf", "\xc1\xbf", "\xe0\x9f\xbf", "\xed\xa0\x80", "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xe4\xb8", "\xe4\xb8" "a" };
+    const CStringSimd::isa_t supported_isa = CStringSimd::get_supported_isa();
+
+    for (size_t i=0; i<sizeof(valid)/sizeof(valid[0]); ++i)
+    {
+        if (CStringSimd::find_invalid_utf8(valid[i], strlen(valid[i])) != strlen(valid[i]))
+        {
+            printf("valid utf-8 %zu rejected\n", i);
+            return false;
+        }
+    }
+    for (size_t i=0; i<sizeof(invalid)/sizeof(invalid[0]); ++i)
+    {
+        if (CStringSimd::find_invalid_utf8(invalid[i], strlen(invalid[i])) != 0)
+        {
+            printf("invalid utf-8 %zu accepted\n", i);
+            return false;
+        }
+    }
+
+    // 穷举所有的1至3字节序列，4字节的首字节穷举、后续字节取边界值，放在跨向量边界的各个位置
+    static const unsigned char tails[] = { 0x00, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xff };
+    for (size_t position=0; position<70; position+=(position < 36? 1: 17))
+    {
+        std::string str(position, 'a');
+        for (int b1=0; b1<256; ++b1)
+        {
+            for (size_t x=0; x<sizeof(tails); ++x)
+            {
+                for (size_t y=0; y<sizeof(tails); ++y)
+                {
+                    for (size_t z=0; z<sizeof(tails); ++z)
+                    {
+                        str.resize(position);
+                        str.push_back(static_cast<char>(b1));
+                        str.push_back(static_cast<char>(tails[x]));
+                        str.push_back(static_cast<char>(tails[y]));
+                        str.push_back(static_cast<char>(tails[z]));
+                        str.append(position % 5, 'b');
+                        if (!check_utf8(str, supported_isa))
+                            return false;
+                    }
+                }
+            }
+        }
+    }
+    for (int b1=0xc0; b1<0xf8; ++b1)
+    {
+        for (int b2=0; b2<256; ++b2)
+        {
+            for (int b3=0x70; b3<0xd0; ++b3)
+            {
+                char bytes[3] = { static_cast<char>(b1), static_cast<char>(b2), static_cast<char>(b3) };
+                if (!check_utf8(std::string(30, 'a') + std::string(bytes, 3) + "\xe4\xb8\xad", supported_isa))
+                    return false;
+            }
+        }
+    }
+
+    // 随机的合法UTF-8中插入一个随机字节
+    static const char* chars[] = { "a", "\xc3\xa9", "中", "😀", "\xef\xbf\xbf", "\xf4\x8f\xbf\xbf" };
+    for (int n=0; n<20000; ++n)
+    {
+        std::string str;
+        const size_t count = random() % 100;
+        for (size_t i=0; i<count; ++i)
+            str += chars[random() % (sizeof(chars)/sizeof(chars[0]))];
+        if (!check_utf8(str, supported_isa))
+            return false;
+        if (!str.empty() && (n % 2 == 0))
+            str[random() % str.size()] = static_cast<char>(random() % 256);
+        if (!check_utf8(str, supported_isa))
+            return false;
+    }
+
+    return true;
+}
+
+// 转义规则同mysql_escape_string
+static bool test_escape_mysql()
+{
+    const std::string str("a\0b\nc\rd\\e'f\"g\032h\xe4\xb8\xad", 18);
+    const std::string expected("a\\0b\\nc\\rd\\\\e\\'f\\\"g\\Zh\xe4\xb8\xad", 25);
+    std::string escaped(str.size()*2, '\0');
+
+    escaped.resize(CStringSimd::escape_mysql(str.data(), str.size(), &escaped[0]));
+    return (escaped == expected) && (CStringSimd::find_mysql_escape(str.data(), str.size()) == 1)
+        && (CStringSimd::find_mysql_escape("abc", 3) == 3);
+}
+
+// CStringUtils的行为保持不变
+static bool test_string_utils()
+{
+    char buffer[] = "  \tHello World! \r\n";
+    CStringUtils::trim(buffer);
+    if (0 != strcmp(buffer, "\tHello World!"))
+        return false;
+    std::string str = "\t\n  Hello World! \t ";
+    if ((CStringUtils::trim_left(std::string(str)) != "Hello World! \t ")
+     || (CStringUtils::trim_right(std::string(str)) != "\t\n  Hello World!")
+     || (CStringUtils::trim(std::string(str)) != "Hello World!")
+     || (CStringUtils::trim(std::string("  \t ")) != ""))
+        return false;
+    if ((CStringUtils::to_upper(std::string("abc@XYZ[123`")) != "ABC@XYZ[123`")
+     || (CStringUtils::to_lower(std::string("abc@XYZ[123`")) != "abc@xyz[123`"))
+        return false;
+
+    if (!CStringUtils::is_numeric_string("") || !CStringUtils::is_numeric_string("12345678901234567890123456789012345")
+     || !CStringUtils::is_numeric_string("2017.") || !CStringUtils::is_numeric_string("3.14159265358979323846264338327950288")
+     || CStringUtils::is_numeric_string(".2017") || CStringUtils::is_numeric_string("1.2.3")
+     || CStringUtils::is_numeric_string("3.14", false) || CStringUtils::is_numeric_string("12345678901234567890x"))
+        return false;
+    if (!CStringUtils::is_alphabetic_string("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ")
+     || CStringUtils::is_alphabetic_string("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXY@"))
+        return false;
+
+    const std::string bytes("\x00\x01\x7f\x80\xab\xff", 6);
+    if ((CStringUtils::to_hex(bytes) != "00017f80abff") || (CStringUtils::to_hex(bytes, false) != "00017F80ABFF"))
+        return false;
+    return (0xAB == CStringUtils::hex2char("ab")) && (0xAB == CStringUtils::hex2char("AB")) && (0x0F == CStringUtils::hex2char("f"));
+}
+
+int main()
+{
+    printf("supported isa: %s\n", isa_name(CStringSimd::get_supported_isa()));
+    if (!test_kernels())
+        return 1;
+    if (!test_utf8())
+        return 1;
+    if (!test_escape_mysql())
+    {
+        printf("escape mysql mismatch\n");
+        return 1;
+    }
+    if (!test_string_utils())
+    {
+        printf("string utils mismatch\n");
+        return 1;
+    }
+
+    printf("string simd ok\n");
+    return 0;
+}
@@ -83,5 +83,23 @@ int main()
     CStringUtils::trim(str10);
     printf("123%s789\n", str10);
 
+    printf("\n\n>>>>>>>>>>TEST uint64_toa<<<<<<<<<<\n\n");
+    const uint64_t numbers[] = { 0, 7, 10, 99, 100, 12345, 4294967295U, 18446744073709551615ULL };
+    for (size_t i=0; i<sizeof(numbers)/sizeof(numbers[0]); ++i)
+    {
+        char buffer[sizeof("18446744073709551615")];
+        char expected[sizeof("18446744073709551615")];
+        const int length = CStringUtils::uint64_toa(numbers[i], buffer);
+        buffer[length] = '\0';
+        snprintf(expected, sizeof(expected), "%" PRIu64, numbers[i]);
+
+        if (strcmp(expected, buffer) != 0)
+        {
+            printf("ERROR uint64_toa: %s\n", buffer);
+            return 1;
+        }
+        printf("%s\n", buffer);
+    }
+
     return 0;    
 }
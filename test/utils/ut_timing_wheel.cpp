@@ -0,0 +1,99 @@
+#include "mooon/utils/timing_wheel.h"
+#include <vector>
+UTILS_NAMESPACE_USE
+
+class CConnection: public CWheelTimeoutable
+{
+public:
+    CConnection(int id)
+        :_id(id)
+        ,_timeout_time(0)
+    {
+    }
+
+    int get_id() const { return _id; }
+    uint64_t get_timeout_time() const { return _timeout_time; }
+    void set_timeout_time(uint64_t timeout_time) { _timeout_time = timeout_time; }
+
+private:
+    int _id;
+    uint64_t _timeout_time;
+};
+
+class CTimeoutHandler: public ITimeoutHandler<CConnection>
+{
+public:
+    CTimeoutHandler()
+        :_now(0)
+        ,_number(0)
+    {
+    }
+
+    void set_now(uint64_t now) { _now = now; }
+    int get_number() const { return _number; }
+
+private:
+    virtual void on_timeout_event(CConnection* connection)
+    {
+        connection->set_timeout_time(_now);
+        ++_number;
+    }
+
+private:
+    uint64_t _now;
+    int _number;
+};
+
+int main()
+{
+    // 测试不同的超时时长：包括级联到第二层和第三层的
+    const uint32_t timeouts[] = { 1, 10, 255, 256, 1000, 65535, 65536, 100000 };
+    const int number = sizeof(timeouts) / sizeof(timeouts[0]);
+    CTimingWheel<CConnection> timing_wheel;
+    CTimeoutHandler timeout_handler;
+    std::vector<CConnection*> connections;
+    int errors = 0;
+
+    timing_wheel.set_timeout_handler(&timeout_handler);
+    for (int i=0; i<number; ++i)
+    {
+        CConnection* connection = new CConnection(i);
+        connections.push_back(connection);
+        timing_wheel.push(connection, 1000, timeouts[i]);
+    }
+
+    // 删除一个，并更新另一个
+    timing_wheel.remove(connections[1]);
+    timing_wheel.update(connections[2], 1100);
+
+    for (uint64_t now=1000; now<=1000+110000; ++now)
+    {
+        timeout_handler.set_now(now);
+        timing_wheel.check_timeout(now);
+    }
+
+    for (int i=0; i<number; ++i)
+    {
+        const uint64_t start = (2 == i)? 1100: 1000;
+        const uint64_t expected = start + timeouts[i];
+        const uint64_t actual = connections[i]->get_timeout_time();
+
+        if (1 == i)
+        {
+            printf("connection[%d]: removed, timeout at %" PRIu64"\n", i, actual);
+            if (actual != 0) ++errors;
+        }
+        else
+        {
+            // 允许最多晚1个刻度，但不能提前
+            printf("connection[%d]: timeout=%u, expected=%" PRIu64", actual=%" PRIu64"\n", i, timeouts[i], expected, actual);
+            if ((actual < expected) || (actual > expected+1)) ++errors;
+        }
+        delete connections[i];
+    }
+
+    printf("timeout number: %d (expected %d), size: %u\n", timeout_handler.get_number(), number-1, timing_wheel.size());
+    if (errors > 0)
+        printf("ERROR: %d\n", errors);
+    return (0 == errors)? 0: 1;
+}
@@ -15,8 +15,87 @@ void print(const std::string& source, const std::string& sep, bool skip_sep=fals
     printf("\n");
 }
 
+// split_offsets和split_views的结果须和split一致
+static bool check(const std::string& source, const std::string& sep, bool skip_sep, const char* expected[], int num_expected)
+{
+    std::vector<std::string> tokens;
+    std::vector<std::pair<size_t, size_t> > offsets;
+    std::vector<std::string_view> views;
+    utils::CTokener::split(&tokens, source, sep, skip_sep);
+    utils::CTokener::split_offsets(&offsets, source, sep, skip_sep);
+    utils::CTokener::split_views(&views, source, sep, skip_sep);
+
+    if ((static_cast<int>(tokens.size()) != num_expected) || (offsets.size() != tokens.size()) || (views.size() != tokens.size()))
+    {
+        printf("check [%s] failed: %zu tokens\n", source.c_str(), tokens.size());
+        return false;
+    }
+    for (int i=0; i<num_expected; ++i)
+    {
+        if ((tokens[i] != expected[i]) || (source.substr(offsets[i].first, offsets[i].second) != expected[i]) || (views[i] != expected[i]))
+        {
+            printf("check [%s] token %d failed: \"%s\"\n", source.c_str(), i, tokens[i].c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// CEnhancedTokenerView的结果须和CEnhancedTokener一致，值在get_decoded时才解码
+static bool check_view()
+{
+    const std::string query = "q=hello+world%21&&page=2&flag&q2=a%2Bb&page=3&empty=";
+    utils::CEnhancedTokener tokener;
+    utils::CEnhancedTokenerView view;
+    tokener.parse(query, "&");
+    if (view.parse(query, "&") != 6)
+        return false;
+
+    const char* names[] = { "q", "page", "flag", "q2", "empty" };
+    for (size_t i=0; i<sizeof(names)/sizeof(names[0]); ++i)
+    {
+        if (!view.exist(names[i]) || (view[names[i]] != tokener[names[i]]))
+        {
+            printf("check view %s failed: %s\n", names[i], std::string(view[names[i]]).c_str());
+            return false;
+        }
+    }
+    if (view.exist("none") || view.exist("pag") || !view["none"].empty())
+        return false;
+    if ((view.get_decoded("q") != "hello world!") || (view.get_decoded("q2") != "a+b") || (view.get_decoded("page") != "3"))
+        return false;
+
+    // 临时的source由view保管
+    view.clear();
+    view.parse(query.substr(0, 16), "&");
+    view.parse(std::string("x=1;y=2"), ";");
+    return (3 == view.size()) && (view.get_decoded("q") == "hello world!") && (view["y"] == "2") && !view.exist("page");
+}
+
 int main()
 {
+    const char* expected1[] = { "", "abc", "123", "x#z", "456", "" };
+    const char* expected2[] = { "", "abc", "", "", "123", "x#z", "456", "", "" };
+    const char* expected3[] = { "", "abc", "123", "efg", "456", "" };
+    const char* expected4[] = { "abc" };
+    if (!check("##abc######123##x#z##456####", "##", true, expected1, 6)
+     || !check("##abc######123##x#z##456####", "##", false, expected2, 9)
+     || !check("  abc  123    efg 456  ", " ", true, expected3, 6)
+     || !check("abc", "", false, expected4, 1)
+     || !check("", "#", false, NULL, 0))
+        return 1;
+    if (!check_view())
+        return 1;
+
+    // 大字符串按单字符分隔，单遍完成
+    std::string big;
+    for (int i=0; i<100000; ++i)
+        big += "field|";
+    std::vector<std::pair<size_t, size_t> > offsets;
+    if ((utils::CTokener::split_offsets(&offsets, big, "|") != 100001) || (offsets[99999].first != 99999*6))
+        return 1;
+
     std::string str1 = "abc##123##x#z##456";
     print(str1, "##");
 
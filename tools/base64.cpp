@@ -1,6 +1,42 @@
 // Writed by yijian on 2018/12/23
+#include <mooon/utils/codec.h>
 #include <mooon/utils/crypto.h>
 #include <mooon/utils/string_utils.h>
+#include <unistd.h>
+
+// 不指定string时从标准输入读，分段编解码后写到标准输出，可处理大文件
+static int stream(int action)
+{
+    static char input[1024*1024];
+    static char output[(1024*1024+2)/3*4+8];
+    mooon::utils::CBase64Encoder encoder;
+    mooon::utils::CBase64Decoder decoder;
+    ssize_t bytes;
+
+    while ((bytes = read(STDIN_FILENO, input, sizeof(input))) > 0)
+    {
+        const ssize_t n = (1 == action)? static_cast<ssize_t>(encoder.update(input, bytes, output)): decoder.update(input, bytes, output);
+        if (n < 0)
+        {
+            fprintf(stderr, "invalid base64\n");
+            return 1;
+        }
+        if ((n > 0) && (write(STDOUT_FILENO, output, n) != n))
+            return 1;
+    }
+
+    const ssize_t n = (1 == action)? static_cast<ssize_t>(encoder.finish(output)): decoder.finish(output);
+    if (n < 0)
+    {
+        fprintf(stderr, "invalid base64\n");
+        return 1;
+    }
+    if ((n > 0) && (write(STDOUT_FILENO, output, n) != n))
+        return 1;
+    if (1 == action)
+        printf("\n");
+    return 0;
+}
 
 int main(int argc, char* argv[])
 {
@@ -9,15 +45,19 @@ int main(int argc, char* argv[])
 
     if (argc < 2)
     {
-        fprintf(stderr, "usage: base64 action(1: encode, 2: deconde) string\n");
+        fprintf(stderr, "usage: base64 action(1: encode, 2: deconde) [string]\n");
         exit(1);
     }
     if (!mooon::utils::CStringUtils::string2int(argv[1], action) ||
         (action!=1 && action!=2))
     {
-        fprintf(stderr, "usage: base64 action(1: encode, 2: deconde) string\n");
+        fprintf(stderr, "usage: base64 action(1: encode, 2: deconde) [string]\n");
         exit(1);
     }
+    else if (argc < 3)
+    {
+        return stream(action);
+    }
     else
     {
         const std::string& src = argv[2];
@@ -0,0 +1,109 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 结构化二进制日志解码工具，将CLogger以二进制格式写的日志文件转成文本，
+// 可按日志级别和时间范围过滤，示例：
+// bin_log_decoder --file=test.log --level=WARN --begin="2012-12-12 12:00:00" --end="2012-12-12 13:00:00"
+#include <mooon/sys/bin_log.h>
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/utils/args_parser.h>
+#include <time.h>
+
+STRING_ARG_DEFINE(file, "", "binary log file");
+STRING_ARG_DEFINE(level, "DETAIL", "minimum log level: DETAIL, DEBUG, INFO, WARN, ERROR, FATAL, STATE or TRACE");
+STRING_ARG_DEFINE(begin, "", "begin time (inclusive), format: YYYY-MM-DD hh:mm:ss");
+STRING_ARG_DEFINE(end, "", "end time (exclusive), format: YYYY-MM-DD hh:mm:ss");
+
+// 将“YYYY-MM-DD hh:mm:ss”转成微秒时间戳，为空时返回default_value
+static bool to_timestamp(const std::string& datetime, uint64_t default_value, uint64_t* timestamp)
+{
+    struct tm tm;
+
+    if (datetime.empty())
+    {
+        *timestamp = default_value;
+        return true;
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(datetime.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if ((NULL == end) || (*end != '\0'))
+        return false;
+
+    tm.tm_isdst = -1;
+    *timestamp = static_cast<uint64_t>(mktime(&tm)) * 1000000;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+    if (mooon::argument::file->value().empty())
+    {
+        fprintf(stderr, "parameter[--file] is not set\n");
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    const mooon::sys::log_level_t min_log_level = mooon::sys::get_log_level(mooon::argument::level->c_value());
+    uint64_t begin_timestamp, end_timestamp;
+    if (!to_timestamp(mooon::argument::begin->value(), 0, &begin_timestamp))
+    {
+        fprintf(stderr, "invalid parameter[--begin]: %s\n", mooon::argument::begin->c_value());
+        exit(1);
+    }
+    if (!to_timestamp(mooon::argument::end->value(), std::numeric_limits<uint64_t>::max(), &end_timestamp))
+    {
+        fprintf(stderr, "invalid parameter[--end]: %s\n", mooon::argument::end->c_value());
+        exit(1);
+    }
+
+    try
+    {
+        mooon::sys::bin_log_header_t header;
+        mooon::sys::CBinLogReader reader;
+
+        reader.open(mooon::argument::file->c_value());
+        while (reader.next(&header))
+        {
+            if ((header.log_level < min_log_level)
+             || (header.timestamp < begin_timestamp)
+             || (header.timestamp >= end_timestamp))
+                continue;
+
+            const std::string line = reader.get_line();
+            fwrite(line.data(), line.size(), 1, stdout);
+        }
+
+        if (reader.get_skipped_bytes() > 0)
+            fprintf(stderr, "skipped %" PRIu64 " corrupted bytes\n", reader.get_skipped_bytes());
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    return 0;
+}
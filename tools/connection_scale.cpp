@@ -0,0 +1,612 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 海量连接的压测工具：按指定的速率建立并保持N个连接，定期发送ping（由对端回显）并统计往返延迟，
+// 每秒输出连接数、建连速率、ping的延迟分布，以及每个连接的用户态和内核态内存，示例：
+// connection_scale --ip=192.168.1.2 --ports=2016,2017 --sources=192.168.1.10,192.168.1.11 --connections=1000000 --rate=20000 --loops=4
+// 对端可以是mooon_net_bench --mode=server，或任何按字节回显的服务端。
+//
+// 一个本端IP对同一对端IP端口只有一个临时端口范围（net.ipv4.ip_local_port_range，默认约2.8万个），
+// 第i个连接使用第i%S个本端IP（--sources，S个）和第(i/S)%P个对端端口（--ports，P个），
+// 最多可建立S*P*临时端口数个连接，本端IP以IP_BIND_ADDRESS_NO_PORT绑定，见CTcpClient::set_local_ip。
+// 进程的文件句柄数上限被提升到硬限制，仍须系统的fs.nr_open和fs.file-max足够大。
+//
+// 每个连接在所属循环的时间轮（utils::CTimingWheel）中只有一项：建连时为建连超时，建立后为下一次ping的时间，
+// 回显收到连接自己的自适应接收缓冲区（net::CRecvBuffer）中，收完即释放，空闲的连接不占用接收缓冲区。
+#include <mooon/net/event_loop.h>
+#include <mooon/net/recv_buffer.h>
+#include <mooon/net/tcp_client.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/info.h>
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/slab_mem_pool.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/utils/exception.h>
+#include <mooon/utils/string_utils.h>
+#include <mooon/utils/timing_wheel.h>
+#include <mooon/utils/tokener.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+STRING_ARG_DEFINE(ip, "127.0.0.1", "IP of the target");
+STRING_ARG_DEFINE(ports, "2016", "comma separated ports of the target, connections are spread over them");
+STRING_ARG_DEFINE(sources, "", "comma separated local IPs to connect from, chosen by the kernel if empty");
+INTEGER_ARG_DEFINE(uint32_t, connections, 10000, 1, 100000000, "connections to open and hold");
+INTEGER_ARG_DEFINE(uint32_t, rate, 1000, 1, 10000000, "connections to open per second while ramping up");
+INTEGER_ARG_DEFINE(uint16_t, loops, 1, 1, 1024, "event loops driving the connections");
+INTEGER_ARG_DEFINE(uint32_t, ping_interval, 10000, 0, 3600000, "milliseconds between two pings of a connection, no ping if 0");
+INTEGER_ARG_DEFINE(uint32_t, ping_size, 8, 1, 1024, "bytes of a ping, the target should echo them");
+INTEGER_ARG_DEFINE(uint32_t, connect_timeout, 5000, 1, 600000, "milliseconds to connect");
+BOOL_STRING_ARG_DEFINE(reconnect, "true", "reopen failed or closed connections to keep the number");
+INTEGER_ARG_DEFINE(uint32_t, duration, 60, 0, 86400000, "seconds to hold the connections after ramping up, until SIGINT or SIGTERM if 0");
+
+#define TICK_MILLISECONDS     10    // 建连和推进时间轮的定时器间隔，也是时间轮的刻度
+#define RECV_BUFFER_MIN_SIZE  64    // 接收缓冲区的最小级别，一个ping的回显通常一次收完
+#define RECV_POOL_MAX_SIZE    4096
+#define RECV_POOL_BUCKETS     256   // 接收缓冲区池每个级别的块数，同时在收回显的连接很少
+
+enum
+{
+    STATE_CLOSED     = 0,
+    STATE_CONNECTING = 1,
+    STATE_CONNECTED  = 2
+};
+
+// 各事件循环的计数，只由循环线程修改，主线程原子地读取
+struct ScaleStats
+{
+    uint64_t connecting;
+    uint64_t connected;
+    uint64_t connects;        // 累计建立成功的次数
+    uint64_t connect_failures;// 累计建立失败（包括超时）的次数
+    uint64_t port_exhausted;  // 其中因EADDRNOTAVAIL（临时端口用完或本端IP不存在）失败的次数
+    uint64_t peer_closed;     // 累计被对端关闭或出错的已建立的连接数
+    uint64_t pings;
+    uint64_t pongs;
+    uint64_t late_pings;      // 到了ping的时间上一个ping还未收到回显的次数
+};
+
+static inline void add_stat(uint64_t* stat, int64_t value)
+{
+    __atomic_add_fetch(stat, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t load_stat(const uint64_t* stat)
+{
+    return __atomic_load_n(stat, __ATOMIC_RELAXED);
+}
+
+class CScaleLoop;
+
+class CScaleConnection: public mooon::net::CTcpClient, public mooon::utils::CWheelTimeoutable
+{
+public:
+    CScaleConnection(CScaleLoop* owner, mooon::sys::CSlabMemPool* recv_pool)
+        : _owner(owner), _state(STATE_CLOSED), _recv_buffer(RECV_BUFFER_MIN_SIZE, recv_pool), _ping_nanoseconds(0)
+    {
+        inc_refcount(); // 由CScaleLoop所有，事件循环剔除它时不销毁，关闭后复用
+    }
+
+    uint8_t get_state() const { return _state; }
+
+    bool open(mooon::net::CEventLoop* event_loop);
+    void ping(mooon::net::CEventLoop* event_loop);
+    void on_closed();
+
+private:
+    virtual mooon::net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    CScaleLoop* _owner;
+    uint8_t _state;
+    mooon::net::CRecvBuffer _recv_buffer; // 未收完的回显，收完即释放
+    uint64_t _ping_nanoseconds;           // 在途ping发出的时间，为0表示没有在途的ping
+};
+
+// 一个事件循环上的连接，在循环线程中按时间片建连，以时间轮检查建连超时和ping
+class CScaleLoop: public mooon::net::ITimerHandler, public mooon::utils::ITimeoutHandler<CScaleConnection>
+{
+public:
+    CScaleLoop(uint32_t connection_number, uint64_t rate, mooon::sys::CLatencyHistogram* latency)
+        : _rate(rate), _start_milliseconds(0), _opened_number(0), _event_loop(NULL), _timing_wheel(TICK_MILLISECONDS), _latency(latency)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+        _timing_wheel.set_timeout_handler(this);
+        _recv_pool.create(RECV_BUFFER_MIN_SIZE, RECV_POOL_MAX_SIZE, 100, RECV_POOL_BUCKETS);
+        _connections.reserve(connection_number);
+        for (uint32_t i=0; i<connection_number; ++i)
+            _connections.push_back(new CScaleConnection(this, &_recv_pool));
+    }
+
+    ~CScaleLoop()
+    {
+        for (std::vector<CScaleConnection*>::size_type i=0; i<_connections.size(); ++i)
+        {
+            _connections[i]->close();
+            delete _connections[i];
+        }
+    }
+
+    CScaleConnection* get_connection(uint32_t i) const { return _connections[i]; }
+    ScaleStats* get_stats() { return &_stats; }
+    const ScaleStats* get_stats() const { return &_stats; }
+    mooon::sys::CLatencyHistogram* get_latency() const { return _latency; }
+
+    // 开始计时并启动定时器，在循环线程中调用
+    void start(mooon::net::CEventLoop* event_loop)
+    {
+        _event_loop = event_loop;
+        _start_milliseconds = mooon::net::CEventLoop::get_monotonic_milliseconds();
+        (void)event_loop->run_after(TICK_MILLISECONDS, this);
+    }
+
+    // 建连开始时以建连超时放入时间轮，建立后改为ping的间隔，关闭时移出
+    void on_connecting(CScaleConnection* connection)
+    {
+        _timing_wheel.push(connection, mooon::net::CEventLoop::get_monotonic_milliseconds(), mooon::argument::connect_timeout->value());
+    }
+
+    void on_connected(CScaleConnection* connection)
+    {
+        if (mooon::argument::ping_interval->value() > 0)
+            _timing_wheel.push(connection, mooon::net::CEventLoop::get_monotonic_milliseconds(), mooon::argument::ping_interval->value());
+        else
+            _timing_wheel.remove(connection);
+    }
+
+    void on_closed(CScaleConnection* connection)
+    {
+        _timing_wheel.remove(connection);
+    }
+
+    void on_connect_failure(CScaleConnection* connection, int errcode)
+    {
+        add_stat(&_stats.connect_failures, 1);
+        if (EADDRNOTAVAIL == errcode)
+            add_stat(&_stats.port_exhausted, 1);
+        if (mooon::argument::reconnect->is_true())
+            _closed.push_back(connection);
+    }
+
+    void on_peer_closed(CScaleConnection* connection)
+    {
+        add_stat(&_stats.peer_closed, 1);
+        if (mooon::argument::reconnect->is_true())
+            _closed.push_back(connection);
+    }
+
+private:
+    virtual uint32_t on_timer(mooon::net::CEventLoop* event_loop, uint64_t timer_id);
+    virtual void on_timeout_event(CScaleConnection* connection);
+
+private:
+    const uint64_t _rate;                        // 本循环每秒建立的连接数
+    uint64_t _start_milliseconds;
+    uint32_t _opened_number;                     // 已第一次打开的连接数，按速率增长
+    mooon::net::CEventLoop* _event_loop;
+    std::vector<CScaleConnection*> _connections;
+    std::vector<CScaleConnection*> _closed;      // 待重连的
+    mooon::utils::CTimingWheel<CScaleConnection> _timing_wheel; // 建连超时和下一次ping
+    mooon::sys::CSlabMemPool _recv_pool;         // 本循环所有连接的接收缓冲区
+    mooon::sys::CLatencyHistogram* _latency;
+    ScaleStats _stats;
+};
+
+class CScaleStartTask: public mooon::net::ILoopTask
+{
+public:
+    CScaleStartTask(CScaleLoop* scale_loop)
+        : _scale_loop(scale_loop)
+    {
+    }
+
+private:
+    virtual void execute(mooon::net::CEventLoop* event_loop)
+    {
+        _scale_loop->start(event_loop);
+    }
+
+private:
+    CScaleLoop* _scale_loop;
+};
+
+bool CScaleConnection::open(mooon::net::CEventLoop* event_loop)
+{
+    _recv_buffer.clear();
+    _ping_nanoseconds = 0;
+
+    try
+    {
+        const bool connected = async_connect();
+        _state = STATE_CONNECTING;
+        add_stat(&_owner->get_stats()->connecting, 1);
+        event_loop->add(this, connected? EPOLLIN: EPOLLOUT);
+        if (connected)
+        {
+            _state = STATE_CONNECTED;
+            add_stat(&_owner->get_stats()->connecting, -1);
+            add_stat(&_owner->get_stats()->connected, 1);
+            add_stat(&_owner->get_stats()->connects, 1);
+            _owner->on_connected(this);
+        }
+        else
+        {
+            _owner->on_connecting(this);
+        }
+        return true;
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        if (STATE_CONNECTING == _state)
+        {
+            add_stat(&_owner->get_stats()->connecting, -1);
+            close();
+        }
+        _state = STATE_CLOSED;
+        _owner->on_connect_failure(this, ex.errcode());
+        return false;
+    }
+}
+
+// 由事件循环或定时器关闭之后调用，更新计数
+void CScaleConnection::on_closed()
+{
+    _owner->on_closed(this);
+    _recv_buffer.clear();
+    if (STATE_CONNECTING == _state)
+    {
+        add_stat(&_owner->get_stats()->connecting, -1);
+        _owner->on_connect_failure(this, get_socket_error_code());
+    }
+    else if (STATE_CONNECTED == _state)
+    {
+        add_stat(&_owner->get_stats()->connected, -1);
+        _owner->on_peer_closed(this);
+    }
+    _state = STATE_CLOSED;
+}
+
+void CScaleConnection::ping(mooon::net::CEventLoop* event_loop)
+{
+    static const char payload[1024] = { 'p', 'i', 'n', 'g' };
+    const uint32_t ping_size = mooon::argument::ping_size->value();
+
+    if (_ping_nanoseconds != 0)
+    {
+        add_stat(&_owner->get_stats()->late_pings, 1);
+        return;
+    }
+
+    try
+    {
+        // ping很小，发送缓冲区满或只发出一部分都说明对端已不回显
+        if (send(payload, ping_size) == static_cast<ssize_t>(ping_size))
+        {
+            _ping_nanoseconds = mooon::sys::CClock::get_nanoseconds();
+            add_stat(&_owner->get_stats()->pings, 1);
+            return;
+        }
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+    }
+
+    event_loop->remove(this, true);
+    on_closed();
+}
+
+mooon::net::epoll_event_t CScaleConnection::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    if (STATE_CONNECTING == _state)
+    {
+        if ((events & (EPOLLERR | EPOLLHUP)) || (get_socket_error_code() != 0))
+        {
+            on_closed();
+            return mooon::net::epoll_close;
+        }
+
+        set_connected_state();
+        _state = STATE_CONNECTED;
+        add_stat(&_owner->get_stats()->connecting, -1);
+        add_stat(&_owner->get_stats()->connected, 1);
+        add_stat(&_owner->get_stats()->connects, 1);
+        _owner->on_connected(this);
+        return mooon::net::epoll_read;
+    }
+
+    try
+    {
+        const uint32_t ping_size = mooon::argument::ping_size->value();
+        for (;;)
+        {
+            const ssize_t n = _recv_buffer.read_from(this);
+            if (0 == n)
+                break;
+            if (n < 0)
+                return mooon::net::epoll_read;
+
+            // 回显可能分几次到达，收满一个ping才算，多出的（不应有）整个丢弃，收完时缓冲区被释放
+            if (_recv_buffer.size() >= ping_size)
+            {
+                if (_ping_nanoseconds != 0)
+                {
+                    _owner->get_latency()->record(mooon::sys::CClock::get_nanoseconds() - _ping_nanoseconds);
+                    add_stat(&_owner->get_stats()->pongs, 1);
+                    _ping_nanoseconds = 0;
+                }
+                _recv_buffer.drain(_recv_buffer.size() - _recv_buffer.size() % ping_size);
+            }
+        }
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+    }
+
+    on_closed();
+    return mooon::net::epoll_close;
+}
+
+uint32_t CScaleLoop::on_timer(mooon::net::CEventLoop* event_loop, uint64_t timer_id)
+{
+    const uint64_t now = mooon::net::CEventLoop::get_monotonic_milliseconds();
+    _timing_wheel.check_timeout(now);
+
+    // 按速率应已打开的连接数（包括重连的），一个时间片内打开的不超过速率允许的
+    uint64_t due = _rate * (now - _start_milliseconds) / 1000 + 1;
+    uint64_t budget = _rate * TICK_MILLISECONDS / 1000 + 1;
+    while ((budget > 0) && !_closed.empty())
+    {
+        CScaleConnection* connection = _closed.back();
+        _closed.pop_back();
+        --budget;
+        (void)connection->open(event_loop);
+    }
+    while ((budget > 0) && (_opened_number < _connections.size()) && (_opened_number < due))
+    {
+        CScaleConnection* connection = _connections[_opened_number++];
+        --budget;
+        (void)connection->open(event_loop);
+    }
+    return TICK_MILLISECONDS;
+}
+
+// 时间轮回调前已将连接移出：建连中的为建连超时，已建立的到了ping的时间，
+// 连接按速率逐个建立，ping的时间因此均匀地分布在间隔内，而不是每隔一个间隔集中发出
+void CScaleLoop::on_timeout_event(CScaleConnection* connection)
+{
+    if (STATE_CONNECTING == connection->get_state())
+    {
+        _event_loop->remove(connection, true);
+        connection->on_closed();
+    }
+    else if (STATE_CONNECTED == connection->get_state())
+    {
+        connection->ping(_event_loop);
+        if (STATE_CONNECTED == connection->get_state())
+            _timing_wheel.push(connection, mooon::net::CEventLoop::get_monotonic_milliseconds());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 系统所有TCP套接字占用的内存页数，即/proc/net/sockstat中TCP行的mem
+static int64_t get_tcp_memory_pages()
+{
+    FILE* fp = fopen("/proc/net/sockstat", "r");
+    if (NULL == fp)
+        return 0;
+
+    char line[256];
+    int64_t pages = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        const char* mem = strstr(line, " mem ");
+        if ((0 == strncmp(line, "TCP:", 4)) && (mem != NULL))
+        {
+            pages = atoll(mem + 5);
+            break;
+        }
+    }
+
+    fclose(fp);
+    return pages;
+}
+
+static int64_t get_rss_pages()
+{
+    mooon::sys::CInfo::process_page_info_t page_info;
+    return mooon::sys::CInfo::get_process_page_info(page_info)? page_info.resident: 0;
+}
+
+static ScaleStats sum_stats(const std::vector<CScaleLoop*>& loops)
+{
+    ScaleStats total;
+    memset(&total, 0, sizeof(total));
+    for (std::vector<CScaleLoop*>::size_type i=0; i<loops.size(); ++i)
+    {
+        const ScaleStats* stats = loops[i]->get_stats();
+        total.connecting += load_stat(&stats->connecting);
+        total.connected += load_stat(&stats->connected);
+        total.connects += load_stat(&stats->connects);
+        total.connect_failures += load_stat(&stats->connect_failures);
+        total.port_exhausted += load_stat(&stats->port_exhausted);
+        total.peer_closed += load_stat(&stats->peer_closed);
+        total.pings += load_stat(&stats->pings);
+        total.pongs += load_stat(&stats->pongs);
+        total.late_pings += load_stat(&stats->late_pings);
+    }
+    return total;
+}
+
+// 提升文件句柄数的上限，不够时只提示，能建立多少算多少
+static void raise_nofile(uint32_t connection_number)
+{
+    struct rlimit rlimit;
+    if (0 == getrlimit(RLIMIT_NOFILE, &rlimit))
+    {
+        rlimit.rlim_cur = rlimit.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &rlimit);
+        if (rlimit.rlim_cur < static_cast<rlim_t>(connection_number) + 100)
+            fprintf(stderr, "RLIMIT_NOFILE %" PRIu64" is less than connections %u\n", static_cast<uint64_t>(rlimit.rlim_cur), connection_number);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    std::vector<std::string> port_strings;
+    std::vector<std::string> source_strings;
+    std::vector<uint16_t> ports;
+    mooon::utils::CTokener::split(&port_strings, mooon::argument::ports->value(), ",", true);
+    mooon::utils::CTokener::split(&source_strings, mooon::argument::sources->value(), ",", true);
+    for (std::vector<std::string>::size_type i=0; i<port_strings.size(); ++i)
+    {
+        uint16_t port = 0;
+        if (!mooon::utils::CStringUtils::string2int(port_strings[i].c_str(), port) || (0 == port))
+        {
+            fprintf(stderr, "invalid port: %s\n", port_strings[i].c_str());
+            exit(1);
+        }
+        ports.push_back(port);
+    }
+    if (ports.empty())
+    {
+        fprintf(stderr, "parameter[--ports] is not set\n");
+        exit(1);
+    }
+
+    const uint32_t connection_number = mooon::argument::connections->value();
+    const uint16_t loop_number = static_cast<uint16_t>(std::min<uint32_t>(mooon::argument::loops->value(), connection_number));
+    std::vector<CScaleLoop*> loops;
+    mooon::net::CReactorPool reactor_pool;
+    mooon::sys::CLatencyHistogram latency;
+
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    (void)pthread_sigmask(SIG_BLOCK, &sigset, NULL); // 在事件循环线程创建之前，使它们继承
+    signal(SIGPIPE, SIG_IGN);
+    raise_nofile(connection_number);
+
+    try
+    {
+        const mooon::net::ip_address_t ip(mooon::argument::ip->c_value());
+        std::vector<mooon::net::ip_address_t> sources;
+        for (std::vector<std::string>::size_type i=0; i<source_strings.size(); ++i)
+            sources.push_back(mooon::net::ip_address_t(source_strings[i].c_str()));
+
+        const int64_t rss_pages = get_rss_pages();
+        const int64_t tcp_pages = get_tcp_memory_pages();
+        const int64_t page_size = sysconf(_SC_PAGESIZE);
+
+        // 第i个连接在第i%loops个循环上，各循环按总速率的一份建连
+        reactor_pool.create(loop_number, 10000, false);
+        for (uint16_t k=0; k<loop_number; ++k)
+        {
+            const uint32_t number = connection_number / loop_number + ((k < connection_number % loop_number)? 1: 0);
+            const uint64_t rate = std::max<uint64_t>(mooon::argument::rate->value() / loop_number, 1);
+            loops.push_back(new CScaleLoop(number, rate, &latency));
+        }
+        for (uint32_t i=0; i<connection_number; ++i)
+        {
+            CScaleConnection* connection = loops[i % loop_number]->get_connection(i / loop_number);
+            const uint32_t source_index = sources.empty()? 0: (i % sources.size());
+            connection->set_peer(mooon::net::ip_node_t(ports[(i / std::max<size_t>(sources.size(), 1)) % ports.size()], ip));
+            if (!sources.empty())
+                connection->set_local_ip(sources[source_index]);
+        }
+        fprintf(stdout, "connecting to %s ports=%s sources=%s: connections=%u rate=%u/s loops=%u, %zu bytes per connection object\n",
+                ip.to_string().c_str(), mooon::argument::ports->c_value(), sources.empty()? "auto": mooon::argument::sources->c_value(),
+                connection_number, mooon::argument::rate->value(), loop_number, sizeof(CScaleConnection));
+        for (uint16_t k=0; k<loop_number; ++k)
+            reactor_pool.get_loop(k)->post(new CScaleStartTask(loops[k]));
+
+        // 每秒输出一次，建满连接（或建连时长已到）后再保持--duration秒
+        const uint64_t start_milliseconds = mooon::sys::CClock::get_milliseconds();
+        const uint64_t ramp_milliseconds = 1000ull * connection_number / mooon::argument::rate->value();
+        uint64_t hold_milliseconds = 0;
+        uint64_t last_connects = 0;
+        mooon::sys::CHistogramSnapshot total_latency;
+        struct timespec timeout = { 1, 0 };
+        fprintf(stdout, "%8s %10s %10s %10s %10s %10s %9s %9s %9s %9s %10s %10s\n", "seconds", "connected", "connecting",
+                "connects/s", "failures", "closed", "pings/s", "p50(us)", "p99(us)", "max(us)", "user(B)", "kernel(B)");
+        while (-1 == sigtimedwait(&sigset, NULL, &timeout))
+        {
+            const uint64_t now = mooon::sys::CClock::get_milliseconds();
+            const ScaleStats stats = sum_stats(loops);
+            mooon::sys::CHistogramSnapshot snapshot;
+            latency.get_snapshot(&snapshot, true);
+            total_latency.merge(snapshot);
+
+            // 每个已建立连接的用户态内存（进程RSS的增量）和内核态内存（TCP套接字内存页数的增量）
+            double user_bytes = 0, kernel_bytes = 0;
+            if (stats.connected > 0)
+            {
+                user_bytes = static_cast<double>(get_rss_pages() - rss_pages) * page_size / stats.connected;
+                kernel_bytes = static_cast<double>(get_tcp_memory_pages() - tcp_pages) * page_size / stats.connected;
+            }
+            fprintf(stdout, "%8.1f %10" PRIu64" %10" PRIu64" %10" PRIu64" %10" PRIu64" %10" PRIu64" %9" PRIu64" %9.1f %9.1f %9.1f %10.0f %10.0f\n",
+                    (now - start_milliseconds) / 1000.0, stats.connected, stats.connecting, stats.connects - last_connects,
+                    stats.connect_failures, stats.peer_closed, snapshot.get_count(), snapshot.get_percentile(50) / 1000.0,
+                    snapshot.get_percentile(99) / 1000.0, snapshot.get_max() / 1000.0, user_bytes, kernel_bytes);
+            fflush(stdout);
+            last_connects = stats.connects;
+
+            if ((0 == hold_milliseconds) && ((stats.connected >= connection_number) || (now - start_milliseconds >= ramp_milliseconds + mooon::argument::connect_timeout->value())))
+                hold_milliseconds = now;
+            if ((hold_milliseconds > 0) && (mooon::argument::duration->value() > 0) && (now - hold_milliseconds >= 1000ull * mooon::argument::duration->value()))
+                break;
+        }
+
+        const ScaleStats stats = sum_stats(loops);
+        fprintf(stdout, "connects: %" PRIu64", failures: %" PRIu64" (EADDRNOTAVAIL: %" PRIu64"), closed by peer: %" PRIu64", receive buffers: %" PRId64" bytes\n",
+                stats.connects, stats.connect_failures, stats.port_exhausted, stats.peer_closed,
+                mooon::sys::CMetricsRegistry::get_singleton()->get_gauge("recv_buffer.bytes")->get());
+        fprintf(stdout, "pings: %" PRIu64", pongs: %" PRIu64", late: %" PRIu64", latency(us): p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+                stats.pings, stats.pongs, stats.late_pings, total_latency.get_percentile(50) / 1000.0, total_latency.get_percentile(90) / 1000.0,
+                total_latency.get_percentile(99) / 1000.0, total_latency.get_percentile(99.9) / 1000.0, total_latency.get_max() / 1000.0);
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        errmsg = ex.str();
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        errmsg = ex.str();
+    }
+
+    // 先停止事件循环，再关闭和销毁连接
+    reactor_pool.destroy();
+    for (std::vector<CScaleLoop*>::size_type i=0; i<loops.size(); ++i)
+        delete loops[i];
+    return errmsg.empty()? 0: 1;
+}
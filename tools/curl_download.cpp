@@ -1,28 +1,330 @@
 // Writed by yijian on 2018/11/14
+//
+// 下载文件，下载完成后按md5sum的格式输出文件的md5：
+// 1) curl_download [-k] [-t timeout] [-n parallel] [-m md5] local_filepath url
+//    不带-n时单连接下载，
+//    带-n时先以HEAD取得文件大小，再以parallel个并发的Range请求下载到预分配的文件中，
+//    各请求以pwrite写入各自的区间，服务端不支持Range时退回单连接下载，
+//    指定-m时校验下载文件的md5
+// 2) curl_download [-k] [-t timeout] [-n parallel] -d local_dir url1 url2 ...
+//    同时下载多个文件到local_dir，文件名为url路径的最后一部分，
+//    HTTPS时协商HTTP/2，多个文件在同一连接上多路复用，-n限制到同一主机的连接数
+#include <fcntl.h>
+#include <getopt.h>
 #include <libgen.h>
+#include <curl/curl.h>
+#include <mooon/sys/curl_multi.h>
 #include <mooon/sys/curl_wrapper.h>
+#include <mooon/sys/file_utils.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/utils/string_utils.h>
+#include <strings.h>
+#include <vector>
+
+static bool sg_enable_insecure = false;
+static int sg_timeout_seconds = 0; // 0表示不超时
 
 static void usage(const char* argv0)
 {
     char* s = strdup(argv0);
-    fprintf(stderr, "Usage: %s <-k> local_filepath url\n", basename(s));
+    fprintf(stderr, "Usage: %s <-k> <-t timeout_seconds> <-n parallel> <-m md5> local_filepath url\n", basename(s));
+    fprintf(stderr, "       %s <-k> <-t timeout_seconds> <-n parallel> -d local_dir url1 url2 ...\n", basename(s));
     free(s);
 }
 
-int main(int argc, char* argv[])
+// 下载一个对象或对象的一个区间
+class CDownloadTransfer: public mooon::sys::CCurlTransfer
 {
-    bool enable_insecure = false;
+public:
+    // size为-1表示下载整个对象
+    CDownloadTransfer(const std::string& url, const std::string& local_filepath, int fd, int64_t offset, int64_t size)
+        : mooon::sys::CCurlTransfer(url, sg_timeout_seconds, 10, sg_enable_insecure),
+          _local_filepath(local_filepath), _fd(fd), _offset(offset), _size(size), _bytes(0), _errcode(-1), _response_code(0)
+    {
+        CURL* curl = static_cast<CURL*>(get_curl());
 
-    if (argc < 3)
+        if (size >= 0)
+        {
+            _range = mooon::utils::CStringUtils::format_string("%" PRId64"-%" PRId64, offset, offset+size-1);
+            (void)curl_easy_setopt(curl, CURLOPT_RANGE, _range.c_str());
+        }
+        (void)curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        (void)curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2TLS));
+        // 等待已有连接确定能否多路复用，而不是马上建立新连接
+        (void)curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+
+    bool is_ok() const
     {
-        usage(argv[0]);
-        exit(1);
+        if (_errcode != 0)
+            return false;
+        if (_size >= 0)
+            return (206 == _response_code) && (_bytes == _size);
+        return 200 == _response_code;
     }
-    if (0 == strcmp(argv[1], "-k"))
+
+    void print_error() const
     {
-        enable_insecure = true;
+        if (!_errmsg.empty())
+            fprintf(stderr, "Download %s [%s] failed: %s\n", get_url().c_str(), _range.c_str(), _errmsg.c_str());
+        else
+            fprintf(stderr, "Download %s [%s] failed: response code %d, %" PRId64" bytes\n", get_url().c_str(), _range.c_str(), _response_code, _bytes);
     }
-    if (enable_insecure && argc!=4)
+
+    const std::string& get_local_filepath() const { return _local_filepath; }
+    int64_t get_bytes() const { return _bytes; }
+
+private:
+    virtual bool on_response_body(const char* data, size_t size)
+    {
+        // 比请求的区间多，说明服务端忽略了Range
+        if ((_size >= 0) && (_bytes + static_cast<int64_t>(size) > _size))
+            return false;
+
+        for (size_t written=0; written<size;)
+        {
+            const ssize_t bytes = pwrite(_fd, data+written, size-written, _offset+_bytes);
+            if (-1 == bytes)
+            {
+                if (EINTR == errno)
+                    continue;
+                _errmsg = mooon::utils::CStringUtils::format_string("pwrite %s error: %s", _local_filepath.c_str(), strerror(errno));
+                return false;
+            }
+
+            written += bytes;
+            _bytes += bytes;
+        }
+
+        return true;
+    }
+
+    virtual void on_finished(int errcode, const std::string& errmsg)
+    {
+        _errcode = errcode;
+        if (_errmsg.empty())
+            _errmsg = errmsg;
+        _response_code = get_response_code();
+    }
+
+private:
+    const std::string _local_filepath;
+    const int _fd;
+    const int64_t _offset;
+    const int64_t _size;
+    int64_t _bytes;
+    std::string _range;
+    int _errcode;
+    std::string _errmsg;
+    int _response_code;
+};
+
+static size_t on_probe_header(void* buffer, size_t size, size_t nmemb, void* userdata)
+{
+    static const char accept_ranges[] = "Accept-Ranges: bytes";
+    if ((size*nmemb >= sizeof(accept_ranges)-1) && (0 == strncasecmp(static_cast<char*>(buffer), accept_ranges, sizeof(accept_ranges)-1)))
+        *static_cast<bool*>(userdata) = true;
+    return size * nmemb;
+}
+
+// 以HEAD取得对象的大小，以及是否支持Range，
+// 返回-1表示大小未知或不支持Range
+static int64_t probe_size(const std::string& url)
+{
+    CURL* curl = curl_easy_init();
+    bool accept_ranges = false;
+    curl_off_t content_length = -1;
+    long response_code = 0;
+
+    (void)curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    (void)curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    (void)curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    (void)curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    (void)curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    (void)curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, sg_enable_insecure? 0L: 1L);
+    (void)curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, sg_enable_insecure? 0L: 2L);
+    (void)curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, on_probe_header);
+    (void)curl_easy_setopt(curl, CURLOPT_HEADERDATA, &accept_ranges);
+    const CURLcode errcode = curl_easy_perform(curl);
+    if (CURLE_OK == errcode)
+    {
+        (void)curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+        (void)curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+    }
+    curl_easy_cleanup(curl);
+
+    if ((errcode != CURLE_OK) || (response_code != 200) || !accept_ranges)
+        return -1;
+    return static_cast<int64_t>(content_length);
+}
+
+// 执行所有传输，都成功返回true
+static bool run_transfers(const std::vector<CDownloadTransfer*>& transfers, int parallel)
+{
+    mooon::sys::CCurlMulti curl_multi(NULL, static_cast<uint32_t>(parallel));
+    curl_multi.create();
+    for (std::vector<CDownloadTransfer*>::size_type i=0; i<transfers.size(); ++i)
+        curl_multi.add(transfers[i]);
+    while (curl_multi.run(1000) > 0);
+
+    bool ok = true;
+    for (std::vector<CDownloadTransfer*>::size_type i=0; i<transfers.size(); ++i)
+    {
+        if (!transfers[i]->is_ok())
+        {
+            transfers[i]->print_error();
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 按md5sum的格式输出，expected_md5不为空时校验
+static bool print_md5(const std::string& local_filepath, const std::string& expected_md5)
+{
+    std::string md5;
+    (void)mooon::sys::CFileUtils::md5sum(&md5, local_filepath.c_str());
+    fprintf(stdout, "%s  %s\n", md5.c_str(), local_filepath.c_str());
+    if (!expected_md5.empty() && (0 != strcasecmp(md5.c_str(), expected_md5.c_str())))
+    {
+        fprintf(stderr, "md5 mismatch: %s, expected %s\n", md5.c_str(), expected_md5.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 以parallel个Range请求下载一个对象
+static bool download_ranges(const std::string& local_filepath, const std::string& url, int parallel)
+{
+    const int64_t size = probe_size(url);
+    const int fd = open(local_filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(mooon::utils::CStringUtils::format_string("open %s error: %s", local_filepath.c_str(), strerror(errno)), errno, "open");
+
+    // 预分配，避免并发pwrite造成文件碎片，文件系统不支持时只设置大小
+    if ((size > 0) && (posix_fallocate(fd, 0, size) != 0) && (-1 == ftruncate(fd, size)))
+    {
+        const int errcode = errno;
+        close(fd);
+        THROW_SYSCALL_EXCEPTION(mooon::utils::CStringUtils::format_string("ftruncate %s error: %s", local_filepath.c_str(), strerror(errcode)), errcode, "ftruncate");
+    }
+
+    std::vector<CDownloadTransfer*> transfers;
+    if (size <= 0)
+    {
+        fprintf(stderr, "Range not supported by %s, download with one connection\n", url.c_str());
+        transfers.push_back(new CDownloadTransfer(url, local_filepath, fd, 0, -1));
+    }
+    else
+    {
+        const int64_t range_size = (size + parallel - 1) / parallel;
+        for (int64_t offset=0; offset<size; offset+=range_size)
+            transfers.push_back(new CDownloadTransfer(url, local_filepath, fd, offset, std::min(range_size, size-offset)));
+    }
+
+    bool ok = false;
+    try
+    {
+        ok = run_transfers(transfers, parallel);
+    }
+    catch (mooon::utils::CException&)
+    {
+        for (std::vector<CDownloadTransfer*>::size_type i=0; i<transfers.size(); ++i)
+            delete transfers[i];
+        close(fd);
+        throw;
+    }
+
+    for (std::vector<CDownloadTransfer*>::size_type i=0; i<transfers.size(); ++i)
+        delete transfers[i];
+    close(fd);
+    return ok;
+}
+
+// 同时下载多个对象到local_dir
+static bool download_objects(const std::string& local_dir, const std::vector<std::string>& urls, int parallel)
+{
+    std::vector<CDownloadTransfer*> transfers;
+    std::vector<int> fds;
+    bool ok = true;
+
+    for (std::vector<std::string>::size_type i=0; ok && (i<urls.size()); ++i)
+    {
+        // 去掉查询参数后，取路径的最后一部分作为文件名
+        std::string filename = urls[i].substr(0, urls[i].find_first_of("?#"));
+        filename = filename.substr(filename.rfind('/')+1);
+        if (filename.empty())
+            filename = mooon::utils::CStringUtils::format_string("index.%d", static_cast<int>(i));
+
+        const std::string local_filepath = local_dir + "/" + filename;
+        const int fd = open(local_filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM);
+        if (-1 == fd)
+        {
+            fprintf(stderr, "open %s error: %s\n", local_filepath.c_str(), strerror(errno));
+            ok = false;
+            break;
+        }
+
+        fds.push_back(fd);
+        transfers.push_back(new CDownloadTransfer(urls[i], local_filepath, fd, 0, -1));
+    }
+
+    try
+    {
+        if (ok)
+            ok = run_transfers(transfers, (parallel > 1)? parallel: 0);
+        for (std::vector<CDownloadTransfer*>::size_type i=0; ok && (i<transfers.size()); ++i)
+            ok = print_md5(transfers[i]->get_local_filepath(), std::string(""));
+    }
+    catch (mooon::utils::CException&)
+    {
+        ok = false;
+        for (std::vector<CDownloadTransfer*>::size_type i=0; i<transfers.size(); ++i)
+            delete transfers[i];
+        for (std::vector<int>::size_type i=0; i<fds.size(); ++i)
+            close(fds[i]);
+        throw;
+    }
+
+    for (std::vector<CDownloadTransfer*>::size_type i=0; i<transfers.size(); ++i)
+        delete transfers[i];
+    for (std::vector<int>::size_type i=0; i<fds.size(); ++i)
+        close(fds[i]);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string local_dir;
+    std::string expected_md5;
+    int parallel = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "kt:n:m:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k':
+            sg_enable_insecure = true;
+            break;
+        case 't':
+            sg_timeout_seconds = atoi(optarg);
+            break;
+        case 'n':
+            parallel = atoi(optarg);
+            break;
+        case 'm':
+            expected_md5 = optarg;
+            break;
+        case 'd':
+            local_dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if ((parallel < 0) || (local_dir.empty() && (argc-optind != 2)) || (!local_dir.empty() && (argc-optind < 1)))
     {
         usage(argv[0]);
         exit(1);
@@ -30,12 +332,36 @@ int main(int argc, char* argv[])
 
     try
     {
-        const std::string& local_filepath = enable_insecure? argv[2]: argv[1];
-        const std::string& url = enable_insecure? argv[3]: argv[2];
-        mooon::sys::CCurlWrapper curl;
-        std::string response_header;
-        curl.http_get_download(response_header, local_filepath, url, enable_insecure);
+        mooon::sys::CStopWatch stopwatch;
+
+        if (!local_dir.empty())
+        {
+            const std::vector<std::string> urls(argv+optind, argv+argc);
+            mooon::sys::CCurlWrapper::global_init();
+            const bool ok = download_objects(local_dir, urls, parallel);
+            fprintf(stdout, "COST: %.3fs\n", stopwatch.get_elapsed_microseconds() / 1000000.0);
+            exit(ok? 0: 1);
+        }
+
+        const std::string& local_filepath = argv[optind];
+        const std::string& url = argv[optind+1];
+        if (parallel > 0)
+        {
+            mooon::sys::CCurlWrapper::global_init();
+            if (!download_ranges(local_filepath, url, parallel))
+                exit(1);
+        }
+        else
+        {
+            mooon::sys::CCurlWrapper curl;
+            std::string response_header;
+            curl.http_get_download(response_header, local_filepath, url, sg_enable_insecure);
+        }
 
+        const uint64_t microseconds = stopwatch.get_elapsed_microseconds();
+        if (!print_md5(local_filepath, expected_md5))
+            exit(1);
+        fprintf(stdout, "COST: %.3fs\n", microseconds / 1000000.0);
         return 0;
     }
     catch (mooon::sys::CSyscallException& ex)
@@ -16,144 +16,590 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
-// 磁盘性能测试工具，用于测试磁盘的读写性能：每秒写和读的笔数、每笔写和读花费的时长
-// 可以指定每次写和读的块大小，以及连读多少次写和读来求平均值。
-#include <mooon/sys/close_helper.h>
-#include <mooon/sys/stop_watch.h>
+// 磁盘性能测试工具，用于测试磁盘的读写性能：每秒写和读的笔数、吞吐，以及每笔写、读和同步的延迟分布。
+// 支持顺序和随机访问、读写混合、O_DIRECT、多种I/O引擎（psync、pwritev、mmap、io_uring）、
+// io_uring的队列深度、多线程（每个线程访问文件中各自的区域）和多种同步策略，
+// 另可回放日志器（CLogger）的写模式：以O_APPEND打开，每次writev一批变长的日志行，写满后滚动文件。
+//
+// 示例：
+// 先顺序写后顺序读（同旧版）：disk_benchmark --dir=/data --block=4096 --times=100000
+// 随机读写各半，O_DIRECT，io_uring队列深度32：
+//   disk_benchmark --dir=/data --engine=io_uring --pattern=rand --read_percent=50 --direct=1 --iodepth=32
+// 每100次写fdatasync一次：disk_benchmark --sync=fdatasync --sync_every=100
+// 回放日志写，4个线程各写一个日志：disk_benchmark --replay=logger --threads=4 --times=1000000
+#include <mooon/net/io_uring.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
 #include <mooon/utils/print_color.h>
 #include <mooon/utils/string_utils.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <vector>
 
 STRING_ARG_DEFINE(dir, ".", "temporary file directory");
 INTEGER_ARG_DEFINE(uint32_t, block, 4096, 1, 1024*1024*1024, "block bytes");
-INTEGER_ARG_DEFINE(uint32_t, times, 100000, 1, std::numeric_limits<uint32_t>::max(), "times to write and read");
-INTEGER_ARG_DEFINE(uint8_t, buffer, 1, 0, 1, "buffer write");
+INTEGER_ARG_DEFINE(uint32_t, times, 100000, 1, std::numeric_limits<uint32_t>::max(), "times to write and read of each thread, or log lines of each thread to replay");
+INTEGER_ARG_DEFINE(uint8_t, buffer, 1, 0, 1, "buffer write, 0 is the same as --sync=fsync --sync_every=1");
+STRING_ARG_DEFINE(engine, "psync", "I/O engine: psync (pread/pwrite), pwritev (preadv/pwritev), mmap or io_uring");
+STRING_ARG_DEFINE(pattern, "seq", "access pattern: seq or rand");
+INTEGER_ARG_DEFINE(int, read_percent, -1, -1, 100, "percent of reads in a mixed phase on a prefilled file, -1 to write all and then read all");
+INTEGER_ARG_DEFINE(uint8_t, direct, 0, 0, 1, "open with O_DIRECT, block must be a multiple of 512");
+INTEGER_ARG_DEFINE(uint32_t, iodepth, 1, 1, 4096, "number of I/O in flight of each thread, only for io_uring");
+INTEGER_ARG_DEFINE(uint16_t, threads, 1, 1, 1024, "number of threads, each accesses its own region of the file");
+STRING_ARG_DEFINE(sync, "none", "sync policy of writes: none, fsync, fdatasync or dsync (open with O_DSYNC)");
+INTEGER_ARG_DEFINE(uint32_t, sync_every, 1, 1, std::numeric_limits<uint32_t>::max(), "sync after every N writes of each thread");
+INTEGER_ARG_DEFINE(uint16_t, iovcnt, 4, 1, IOV_MAX, "number of iovec a block is split into, only for pwritev");
+STRING_ARG_DEFINE(replay, "", "replay an access pattern instead: logger");
+INTEGER_ARG_DEFINE(uint16_t, log_batch, 10, 1, IOV_MAX, "log lines of each writev when replaying logger");
+INTEGER_ARG_DEFINE(uint32_t, log_line, 200, 16, 1024*1024, "average bytes of a log line when replaying logger");
+INTEGER_ARG_DEFINE(uint32_t, log_file_mb, 100, 1, 1024*1024, "megabytes to rotate the log file when replaying logger");
+INTEGER_ARG_DEFINE(uint8_t, pause, 1, 0, 1, "wait for ENTER before reading, to allow dropping the page cache");
 
-static char filename[sizeof("disk_benchmark_XXXXXX")] = { '\0' };
-static void onsignal(int signo)
+enum { ENGINE_PSYNC, ENGINE_PWRITEV, ENGINE_MMAP, ENGINE_IO_URING };
+enum { SYNC_NONE, SYNC_FSYNC, SYNC_FDATASYNC, SYNC_DSYNC };
+
+static char filename[PATH_MAX] = { '\0' };
+static int sg_engine = ENGINE_PSYNC;
+static int sg_sync = SYNC_NONE;
+static bool sg_random = false;
+static int sg_fd = -1;
+static char* sg_map = NULL;
+static uint64_t sg_file_size = 0;
+
+// 每个阶段的统计，阶段之间清零
+static mooon::sys::CLatencyHistogram sg_read_histogram;
+static mooon::sys::CLatencyHistogram sg_write_histogram;
+static mooon::sys::CLatencyHistogram sg_sync_histogram;
+static uint64_t sg_read_bytes = 0;
+static uint64_t sg_write_bytes = 0;
+static uint64_t sg_rotate_number = 0;
+
+static void remove_files()
 {
-    if (SIGINT == signo)
+    if (filename[0] != '\0')
     {
-        if (filename[0] != '\0')
+        remove(filename);
+        for (uint16_t i=0; i<mooon::argument::threads->value(); ++i)
         {
-            remove(filename);
-            exit(1);
+            char log_filename[PATH_MAX+32];
+            snprintf(log_filename, sizeof(log_filename), "%s.log%u", filename, i);
+            remove(log_filename);
+            snprintf(log_filename, sizeof(log_filename), "%s.log%u.1", filename, i);
+            remove(log_filename);
         }
     }
 }
 
-int main(int argc, char* argv[])
+static void die(const char* what)
 {
-    fprintf(stdout, "please run under DIRECTORY: " PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"\n", mooon::sys::CUtils::get_program_path().c_str());
+    fprintf(stderr, "%s %s error: %m\n", what, filename);
+    remove_files();
+    exit(1);
+}
 
-    std::string errmsg;
-    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+static void onsignal(int signo)
+{
+    if (SIGINT == signo)
     {
-        fprintf(stderr, "%s\n", errmsg.c_str());
+        remove_files();
         exit(1);
     }
+}
 
-    signal(SIGINT, onsignal);
-    strncpy(filename, "disk_benchmark_XXXXXX", sizeof("disk_benchmark_XXXXXX")-1);
-    int fd = mkstemp(filename);
-    if (-1 == fd)
+static uint64_t next_random(uint64_t* state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static char* allocate_buffer(size_t size)
+{
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, 4096, size) != 0)
+        die("posix_memalign");
+    memset(buffer, '#', size);
+    return static_cast<char*>(buffer);
+}
+
+static void do_sync(uint64_t offset)
+{
+    const uint64_t start_ns = mooon::sys::CClock::get_nanoseconds();
+    if (ENGINE_MMAP == sg_engine)
     {
-        fprintf(stderr, "open %s error: %m\n", filename);
-        remove(filename);
-        exit(1);
+        // msync的地址须按页对齐
+        const uint64_t begin = offset & ~static_cast<uint64_t>(4095);
+        if (-1 == msync(sg_map+begin, offset+mooon::argument::block->value()-begin, MS_SYNC))
+            die("msync");
+    }
+    else if (SYNC_FSYNC == sg_sync)
+    {
+        if (-1 == fsync(sg_fd))
+            die("fsync");
+    }
+    else
+    {
+        if (-1 == fdatasync(sg_fd))
+            die("fdatasync");
+    }
+    sg_sync_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_ns);
+}
+
+static bool need_sync(uint64_t write_number)
+{
+    return (SYNC_NONE != sg_sync) && (SYNC_DSYNC != sg_sync) && (0 == write_number % mooon::argument::sync_every->value());
+}
+
+// 以psync、pwritev或mmap同步地访问，每次一块
+static void sync_io_thread(uint16_t thread_index, int read_percent)
+{
+    const uint32_t block = mooon::argument::block->value();
+    const uint32_t times = mooon::argument::times->value();
+    const uint64_t region_offset = static_cast<uint64_t>(thread_index) * times * block;
+    char* buffer = allocate_buffer(block);
+    uint64_t random_state = 0x9E3779B97F4A7C15ULL * (thread_index + 1);
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+    uint64_t write_number = 0;
+
+    // pwritev将一块分成iovcnt段
+    std::vector<struct iovec> iov(mooon::argument::iovcnt->value());
+    for (std::vector<struct iovec>::size_type i=0; i<iov.size(); ++i)
+    {
+        iov[i].iov_base = buffer + i * (block / iov.size());
+        iov[i].iov_len = (i+1 == iov.size())? block - i * (block / iov.size()): block / iov.size();
     }
 
-    fprintf(stdout, "block size: %u, file: %s\n\n", mooon::argument::block->value(), filename);
-    const std::string buffer(mooon::argument::block->value(), '#');
-    mooon::sys::CStopWatch stop_watch;
-    int64_t total_bytes = 0;
-    ssize_t bytes = 0;
-    for (uint32_t i=0; i<mooon::argument::times->value(); ++i)
+    for (uint32_t i=0; i<times; ++i)
     {
-        bytes = write(fd, buffer.data(), buffer.size());
-        if (bytes != static_cast<ssize_t>(buffer.size()))
+        const uint64_t offset = region_offset + static_cast<uint64_t>(sg_random? next_random(&random_state) % times: i) * block;
+        const bool is_read = (read_percent >= 100) || ((read_percent > 0) && (static_cast<int>(next_random(&random_state) % 100) < read_percent));
+        ssize_t bytes = block;
+
+        const uint64_t start_ns = mooon::sys::CClock::get_nanoseconds();
+        if (ENGINE_MMAP == sg_engine)
         {
-            fprintf(stderr, "write %s error: %m\n", filename);
-            remove(filename);
-            close(fd);
-            exit(1);
+            if (is_read)
+                memcpy(buffer, sg_map+offset, block);
+            else
+                memcpy(sg_map+offset, buffer, block);
+        }
+        else if (ENGINE_PWRITEV == sg_engine)
+        {
+            bytes = is_read? preadv(sg_fd, &iov[0], iov.size(), offset): pwritev(sg_fd, &iov[0], iov.size(), offset);
+        }
+        else
+        {
+            bytes = is_read? pread(sg_fd, buffer, block, offset): pwrite(sg_fd, buffer, block, offset);
+        }
+        const uint64_t elapsed_ns = mooon::sys::CClock::get_nanoseconds() - start_ns;
+
+        if (bytes != static_cast<ssize_t>(block))
+            die(is_read? "read": "write");
+        if (is_read)
+        {
+            sg_read_histogram.record(elapsed_ns);
+            read_bytes += bytes;
         }
+        else
+        {
+            sg_write_histogram.record(elapsed_ns);
+            write_bytes += bytes;
+            if (need_sync(++write_number))
+                do_sync(offset);
+        }
+    }
+
+    __atomic_add_fetch(&sg_read_bytes, read_bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sg_write_bytes, write_bytes, __ATOMIC_RELAXED);
+    free(buffer);
+}
 
-        if (0 == mooon::argument::buffer->value())
+// 以io_uring异步地访问，每个线程最多iodepth个在途，需要同步时先等在途的写完成
+static void io_uring_thread(uint16_t thread_index, int read_percent)
+{
+    const uint32_t block = mooon::argument::block->value();
+    const uint32_t times = mooon::argument::times->value();
+    const uint32_t iodepth = mooon::argument::iodepth->value();
+    const uint64_t region_offset = static_cast<uint64_t>(thread_index) * times * block;
+    const uint64_t sync_tag = iodepth;
+    char* buffers = allocate_buffer(static_cast<size_t>(block) * iodepth);
+    std::vector<uint64_t> start_ns(iodepth);
+    std::vector<bool> is_read(iodepth);
+    std::vector<uint64_t> free_slots;
+    std::vector<uint64_t> tags(iodepth+1);
+    std::vector<int> results(iodepth+1);
+    uint64_t random_state = 0x9E3779B97F4A7C15ULL * (thread_index + 1);
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+    uint64_t write_number = 0;
+    bool sync_pending = false;
+    uint32_t issued = 0;
+    uint32_t completed = 0;
+
+    try
+    {
+        mooon::net::CIoUring ring;
+        ring.create(iodepth);
+        for (uint32_t i=iodepth; i>0; --i)
+            free_slots.push_back(i-1);
+
+        while (completed < times)
         {
-            if (-1 == fsync(fd))
+            while (!sync_pending && !free_slots.empty() && (issued < times))
             {
-                fprintf(stderr, "fsync %s error: %m\n", filename);
-                remove(filename);
-                close(fd);
-                exit(1);
+                const uint64_t slot = free_slots.back();
+                const uint64_t offset = region_offset + static_cast<uint64_t>(sg_random? next_random(&random_state) % times: issued) * block;
+                free_slots.pop_back();
+                is_read[slot] = (read_percent >= 100) || ((read_percent > 0) && (static_cast<int>(next_random(&random_state) % 100) < read_percent));
+                start_ns[slot] = mooon::sys::CClock::get_nanoseconds();
+                if (is_read[slot])
+                {
+                    ring.queue_pread(sg_fd, buffers+slot*block, block, offset, slot);
+                }
+                else
+                {
+                    ring.queue_pwrite(sg_fd, buffers+slot*block, block, offset, slot);
+                    sync_pending = need_sync(++write_number);
+                }
+                ++issued;
             }
+
+            const int number = ring.wait_completions(&tags[0], &results[0], iodepth, 1);
+            const uint64_t end_ns = mooon::sys::CClock::get_nanoseconds();
+            for (int i=0; i<number; ++i)
+            {
+                const uint64_t slot = tags[i];
+                if (results[i] != static_cast<int>(block))
+                {
+                    errno = (results[i] < 0)? -results[i]: EIO;
+                    die(is_read[slot]? "read": "write");
+                }
+                if (is_read[slot])
+                {
+                    sg_read_histogram.record(end_ns - start_ns[slot]);
+                    read_bytes += block;
+                }
+                else
+                {
+                    sg_write_histogram.record(end_ns - start_ns[slot]);
+                    write_bytes += block;
+                }
+                free_slots.push_back(slot);
+                ++completed;
+            }
+
+            if (sync_pending && (free_slots.size() == iodepth))
+            {
+                const uint64_t sync_start_ns = mooon::sys::CClock::get_nanoseconds();
+                uint64_t tag;
+                int result;
+                ring.queue_fsync(sg_fd, SYNC_FDATASYNC == sg_sync, sync_tag);
+                (void)ring.wait_completions(&tag, &result, 1, 1);
+                if (result < 0)
+                {
+                    errno = -result;
+                    die("fsync");
+                }
+                sg_sync_histogram.record(mooon::sys::CClock::get_nanoseconds() - sync_start_ns);
+                sync_pending = false;
+            }
+        }
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "io_uring error: %s\n", ex.str().c_str());
+        remove_files();
+        exit(1);
+    }
+
+    __atomic_add_fetch(&sg_read_bytes, read_bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sg_write_bytes, write_bytes, __ATOMIC_RELAXED);
+    free(buffers);
+}
+
+// 回放CLogger的写：O_APPEND，每次writev一批长度在[log_line/2, log_line*3/2]之间的行，超过大小后滚动
+static void replay_logger_thread(uint16_t thread_index)
+{
+    const uint32_t log_line = mooon::argument::log_line->value();
+    const uint16_t log_batch = mooon::argument::log_batch->value();
+    const uint64_t log_file_size = static_cast<uint64_t>(mooon::argument::log_file_mb->value()) * 1024 * 1024;
+    const int flags = O_WRONLY|O_CREAT|O_APPEND | ((SYNC_DSYNC == sg_sync)? O_DSYNC: 0);
+    char* lines = allocate_buffer(static_cast<size_t>(log_line) * 3 / 2 * log_batch);
+    std::vector<struct iovec> iov(log_batch);
+    uint64_t random_state = 0x9E3779B97F4A7C15ULL * (thread_index + 1);
+    uint64_t write_bytes = 0;
+    uint64_t current_bytes = 0;
+    uint64_t write_number = 0;
+    char log_filename[PATH_MAX+32];
+    char backup_filename[PATH_MAX+32];
+
+    snprintf(log_filename, sizeof(log_filename), "%s.log%u", filename, thread_index);
+    snprintf(backup_filename, sizeof(backup_filename), "%s.log%u.1", filename, thread_index);
+    int fd = open(log_filename, flags|O_TRUNC, 0644);
+    if (-1 == fd)
+        die("open");
+
+    for (uint32_t i=0; i<mooon::argument::times->value(); i+=log_batch)
+    {
+        const uint16_t number = static_cast<uint16_t>(std::min<uint32_t>(log_batch, mooon::argument::times->value()-i));
+        size_t batch_bytes = 0;
+        for (uint16_t j=0; j<number; ++j)
+        {
+            iov[j].iov_base = lines + static_cast<size_t>(log_line) * 3 / 2 * j;
+            iov[j].iov_len = log_line / 2 + next_random(&random_state) % (log_line + 1);
+            static_cast<char*>(iov[j].iov_base)[iov[j].iov_len-1] = '\n';
+            batch_bytes += iov[j].iov_len;
         }
 
-        total_bytes += bytes;
+        const uint64_t start_ns = mooon::sys::CClock::get_nanoseconds();
+        const ssize_t bytes = writev(fd, &iov[0], number);
+        sg_write_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_ns);
+        if (bytes != static_cast<ssize_t>(batch_bytes))
+            die("writev");
+        write_bytes += bytes;
+        current_bytes += bytes;
+
+        if (need_sync(++write_number))
+        {
+            const uint64_t sync_start_ns = mooon::sys::CClock::get_nanoseconds();
+            if (-1 == ((SYNC_FSYNC == sg_sync)? fsync(fd): fdatasync(fd)))
+                die("fsync");
+            sg_sync_histogram.record(mooon::sys::CClock::get_nanoseconds() - sync_start_ns);
+        }
+        if (current_bytes >= log_file_size)
+        {
+            // 同CLogger::rotate_file，备份为.1后重新创建
+            close(fd);
+            if ((-1 == rename(log_filename, backup_filename)) || (-1 == (fd = open(log_filename, flags, 0644))))
+                die("rotate");
+            current_bytes = 0;
+            __atomic_add_fetch(&sg_rotate_number, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    close(fd);
+    __atomic_add_fetch(&sg_write_bytes, write_bytes, __ATOMIC_RELAXED);
+    free(lines);
+}
+
+static void print_latency(const char* name, mooon::sys::CLatencyHistogram* histogram)
+{
+    mooon::sys::CHistogramSnapshot snapshot;
+    histogram->get_snapshot(&snapshot, true);
+    if (snapshot.get_count() > 0)
+    {
+        fprintf(stdout, "%s latency(us): count %" PRIu64", mean %.2f, min %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n",
+                name, snapshot.get_count(), snapshot.get_mean()/1000.0, snapshot.get_min()/1000.0,
+                snapshot.get_percentile(50)/1000.0, snapshot.get_percentile(90)/1000.0, snapshot.get_percentile(99)/1000.0,
+                snapshot.get_percentile(99.9)/1000.0, snapshot.get_max()/1000.0);
     }
+}
+
+// 运行一个阶段并输出结果，read_percent为-2时回放日志写
+static void run_phase(const char* name, int read_percent)
+{
+    sg_read_bytes = 0;
+    sg_write_bytes = 0;
+    sg_rotate_number = 0;
 
-    unsigned int elapsed_microseconds = stop_watch.get_elapsed_microseconds();
-    unsigned int elapsed_milliseconds = elapsed_microseconds / 1000;
-    unsigned int elapsed_seconds = elapsed_microseconds / 1000000;
-    unsigned int iops = (0 == elapsed_seconds)? mooon::argument::times->value(): mooon::argument::times->value()/elapsed_seconds;
-    double rate =  elapsed_microseconds / mooon::argument::times->value();
-    double total_bytes_k = total_bytes / 1024;
-    double total_bytes_m = total_bytes_k / 1024;
-    double bytes_sec = (0 == elapsed_seconds)? total_bytes_m: total_bytes_m / elapsed_seconds;
-    fprintf(stdout, "[" PRINT_COLOR_YELLOW"WRITE" PRINT_COLOR_NONE"]\n");
-    fprintf(stdout, "bytes: %" PRId64" (%.02fMB, %.02fMB/s), times: %u\n", total_bytes, total_bytes_m, bytes_sec, mooon::argument::times->value());
-    fprintf(stdout, "microseconds: %u, milliseconds: %u, seconds: %u\n", elapsed_microseconds, elapsed_milliseconds, elapsed_seconds);
-    fprintf(stdout, "iops: %u, rate: %0.2fus (%0.2fms)\n", iops, rate, rate/1000);
+    const uint64_t start_ns = mooon::sys::CClock::get_nanoseconds();
+    std::vector<mooon::sys::CThreadEngine*> thread_engines(mooon::argument::threads->value());
+    for (uint16_t i=0; i<mooon::argument::threads->value(); ++i)
+    {
+        if (-2 == read_percent)
+            thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(replay_logger_thread, i));
+        else if (ENGINE_IO_URING == sg_engine)
+            thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(io_uring_thread, i, read_percent));
+        else
+            thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(sync_io_thread, i, read_percent));
+    }
+    for (uint16_t i=0; i<mooon::argument::threads->value(); ++i)
+    {
+        thread_engines[i]->join();
+        delete thread_engines[i];
+    }
+    const double seconds = (mooon::sys::CClock::get_nanoseconds() - start_ns) / 1000000000.0;
 
+    const uint64_t total_bytes = sg_read_bytes + sg_write_bytes;
+    const double total_bytes_m = total_bytes / 1024.0 / 1024.0;
+    fprintf(stdout, "[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"]\n", name);
+    fprintf(stdout, "bytes: %" PRIu64" (%.02fMB, %.02fMB/s), read: %" PRIu64", write: %" PRIu64", seconds: %.3f\n",
+            total_bytes, total_bytes_m, total_bytes_m/seconds, sg_read_bytes, sg_write_bytes, seconds);
+    if (-2 == read_percent)
+    {
+        fprintf(stdout, "lines: %" PRIu64" (%.0f/s), writev: %.0f/s, rotates: %" PRIu64"\n",
+                static_cast<uint64_t>(mooon::argument::times->value()) * mooon::argument::threads->value(),
+                mooon::argument::times->value() * mooon::argument::threads->value() / seconds,
+                mooon::argument::times->value() * mooon::argument::threads->value() / mooon::argument::log_batch->value() / seconds,
+                sg_rotate_number);
+    }
+    else
+    {
+        fprintf(stdout, "iops: %.0f\n", (sg_read_bytes + sg_write_bytes) / mooon::argument::block->value() / seconds);
+    }
+    print_latency("read", &sg_read_histogram);
+    print_latency(-2 == read_percent? "writev": "write", &sg_write_histogram);
+    print_latency("sync", &sg_sync_histogram);
+}
+
+// 以1MB的块顺序写满文件，供读和混合阶段使用
+static void prefill_file()
+{
+    const int fd = open(filename, O_WRONLY);
+    const std::string chunk(1024*1024, '#');
+    if (-1 == fd)
+        die("open");
+    for (uint64_t offset=0; offset<sg_file_size; offset+=chunk.size())
+    {
+        const size_t size = static_cast<size_t>(std::min<uint64_t>(chunk.size(), sg_file_size-offset));
+        if (pwrite(fd, chunk.data(), size, offset) != static_cast<ssize_t>(size))
+            die("prefill");
+    }
+    if (-1 == fsync(fd))
+        die("fsync");
     close(fd);
-    fprintf(stdout, "\n" PRINT_COLOR_GREEN);
-    fprintf(stdout, "free pagecache: echo 1 > /proc/sys/vm/drop_caches\n");
-    fprintf(stdout, "free dentries and inodes: echo 2 > /proc/sys/vm/drop_caches\n");
-    fprintf(stdout, "free pagecache, dentries and inodes: echo 3 > /proc/sys/vm/drop_caches\n");
-    fprintf(stdout, "press ENTER to continue ...\n" PRINT_COLOR_NONE);
-    getchar();
-
-    fd = open(filename, O_RDONLY);
+}
+
+static bool parse_options(std::string* errmsg)
+{
+    const std::string& engine = mooon::argument::engine->value();
+    const std::string& sync = mooon::argument::sync->value();
+    const std::string& pattern = mooon::argument::pattern->value();
+    const uint32_t block = mooon::argument::block->value();
+
+    if ("psync" == engine) sg_engine = ENGINE_PSYNC;
+    else if ("pwritev" == engine) sg_engine = ENGINE_PWRITEV;
+    else if ("mmap" == engine) sg_engine = ENGINE_MMAP;
+    else if ("io_uring" == engine) sg_engine = ENGINE_IO_URING;
+    else { *errmsg = "unknown engine: " + engine; return false; }
+
+    if ("none" == sync) sg_sync = (0 == mooon::argument::buffer->value())? SYNC_FSYNC: SYNC_NONE;
+    else if ("fsync" == sync) sg_sync = SYNC_FSYNC;
+    else if ("fdatasync" == sync) sg_sync = SYNC_FDATASYNC;
+    else if ("dsync" == sync) sg_sync = SYNC_DSYNC;
+    else { *errmsg = "unknown sync policy: " + sync; return false; }
+
+    if ("seq" == pattern) sg_random = false;
+    else if ("rand" == pattern) sg_random = true;
+    else { *errmsg = "unknown pattern: " + pattern; return false; }
+
+    if (!mooon::argument::replay->value().empty() && (mooon::argument::replay->value() != "logger"))
+    {
+        *errmsg = "unknown replay: " + mooon::argument::replay->value();
+        return false;
+    }
+    if ((ENGINE_IO_URING == sg_engine) && !mooon::net::CIoUring::is_supported())
+    {
+        *errmsg = "io_uring not supported";
+        return false;
+    }
+    if (mooon::argument::direct->value() != 0)
+    {
+        if (ENGINE_MMAP == sg_engine)
+        {
+            *errmsg = "O_DIRECT does not apply to mmap";
+            return false;
+        }
+        // pwritev的每段也须对齐
+        if ((0 != block % 512) || ((ENGINE_PWRITEV == sg_engine) && (0 != block % (512 * mooon::argument::iovcnt->value()))))
+        {
+            *errmsg = "O_DIRECT requires block (and block/iovcnt for pwritev) to be a multiple of 512";
+            return false;
+        }
+    }
+    if ((ENGINE_PWRITEV == sg_engine) && (block < mooon::argument::iovcnt->value()))
+    {
+        *errmsg = "block is less than iovcnt";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg) || !parse_options(&errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        exit(1);
+    }
+
+    signal(SIGINT, onsignal);
+    snprintf(filename, sizeof(filename), "%s/disk_benchmark_XXXXXX", mooon::argument::dir->c_value());
+    int fd = mkstemp(filename);
     if (-1 == fd)
     {
         fprintf(stderr, "open %s error: %m\n", filename);
-        remove(filename);
         exit(1);
     }
+    close(fd);
 
-    total_bytes = 0;
-    stop_watch.restart();
-    for (uint32_t i=0; i<mooon::argument::times->value(); ++i)
+    fprintf(stdout, "engine: %s, pattern: %s, block size: %u, threads: %u, iodepth: %u, direct: %u, sync: %s/%u, file: %s\n\n",
+            mooon::argument::engine->c_value(), mooon::argument::pattern->c_value(), mooon::argument::block->value(),
+            mooon::argument::threads->value(), (ENGINE_IO_URING == sg_engine)? mooon::argument::iodepth->value(): 1,
+            mooon::argument::direct->value(), (SYNC_NONE == sg_sync)? "none": (SYNC_FSYNC == sg_sync)? "fsync": (SYNC_FDATASYNC == sg_sync)? "fdatasync": "dsync",
+            mooon::argument::sync_every->value(), filename);
+    if ("logger" == mooon::argument::replay->value())
     {
-        bytes = read(fd, const_cast<char*>(buffer.data()), mooon::argument::block->value());
-        if (bytes != static_cast<ssize_t>(buffer.size()))
-        {
-            fprintf(stderr, "read %s error: %m\n", filename);
-            remove(filename);
-            close(fd);
-            exit(1);
-        }
+        run_phase("REPLAY LOGGER", -2);
+        remove_files();
+        return 0;
+    }
 
-        total_bytes += bytes;
+    // 各线程访问各自的区域，随机写时文件须已有足够大小
+    sg_file_size = static_cast<uint64_t>(mooon::argument::times->value()) * mooon::argument::block->value() * mooon::argument::threads->value();
+    if (mooon::argument::read_percent->value() >= 0)
+        prefill_file();
+
+    const int flags = O_RDWR | ((mooon::argument::direct->value() != 0)? O_DIRECT: 0) | ((SYNC_DSYNC == sg_sync)? O_DSYNC: 0);
+    sg_fd = open(filename, flags);
+    if (-1 == sg_fd)
+        die("open");
+    if (-1 == ftruncate(sg_fd, sg_file_size))
+        die("ftruncate");
+    if (ENGINE_MMAP == sg_engine)
+    {
+        void* map = mmap(NULL, sg_file_size, PROT_READ|PROT_WRITE, MAP_SHARED, sg_fd, 0);
+        if (MAP_FAILED == map)
+            die("mmap");
+        sg_map = static_cast<char*>(map);
     }
 
-    elapsed_microseconds = stop_watch.get_elapsed_microseconds();
-    elapsed_milliseconds = elapsed_microseconds / 1000;
-    elapsed_seconds = elapsed_microseconds / 1000000;
-    iops = (0 == elapsed_seconds)? mooon::argument::times->value(): mooon::argument::times->value()/elapsed_seconds;
-    rate =  elapsed_microseconds / mooon::argument::times->value();
-    total_bytes_k = total_bytes / 1024;
-    total_bytes_m = total_bytes_k / 1024;
-    bytes_sec = (0 == elapsed_seconds)? total_bytes_m: total_bytes_m / elapsed_seconds;
-    fprintf(stdout, "[" PRINT_COLOR_YELLOW"READ" PRINT_COLOR_NONE"]\n");
-    fprintf(stdout, "bytes: %" PRId64" (%.02fMB/s), times: %u\n", total_bytes, bytes_sec, mooon::argument::times->value());
-    fprintf(stdout, "microseconds: %u, milliseconds: %u, seconds: %u\n", elapsed_microseconds, elapsed_milliseconds, elapsed_seconds);
-    fprintf(stdout, "iops: %u, rate: %0.2fus (%0.2fms)\n", iops, rate, rate/1000);
+    if (mooon::argument::read_percent->value() >= 0)
+    {
+        char name[sizeof("MIXED 100% READ")];
+        snprintf(name, sizeof(name), "MIXED %d%% READ", mooon::argument::read_percent->value());
+        run_phase(name, mooon::argument::read_percent->value());
+    }
+    else
+    {
+        run_phase("WRITE", 0);
+        if ((1 == mooon::argument::pause->value()) && (0 == mooon::argument::direct->value()))
+        {
+            fprintf(stdout, "\n" PRINT_COLOR_GREEN);
+            fprintf(stdout, "free pagecache: echo 1 > /proc/sys/vm/drop_caches\n");
+            fprintf(stdout, "free dentries and inodes: echo 2 > /proc/sys/vm/drop_caches\n");
+            fprintf(stdout, "free pagecache, dentries and inodes: echo 3 > /proc/sys/vm/drop_caches\n");
+            fprintf(stdout, "press ENTER to continue ...\n" PRINT_COLOR_NONE);
+            getchar();
+        }
+        run_phase("READ", 100);
+    }
 
-    remove(filename);
-    close(fd);
+    if (sg_map != NULL)
+        munmap(sg_map, sg_file_size);
+    close(sg_fd);
+    remove_files();
     return 0;
 }
@@ -0,0 +1,113 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 飞行记录器转储文件的解码工具，将CFlightRecorder转储的文件转成文本，
+// 默认按线程分组输出，--merge=true时所有线程的事件按时间合并输出，示例：
+// flight_recorder_decoder --file=myserver.12345.crash.flight --merge=true
+#include <mooon/sys/flight_recorder.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/utils/exception.h>
+#include <algorithm>
+#include <string.h>
+
+STRING_ARG_DEFINE(file, "", "file dumped by flight recorder");
+INTEGER_ARG_DEFINE(uint32_t, thread, 0, 0, 4294967295U, "only decode events of the thread (kernel thread id), decode all if 0");
+BOOL_STRING_ARG_DEFINE(merge, "false", "merge events of all threads in time order, example: --merge=true");
+
+struct FlightLine
+{
+    const mooon::sys::flight_thread_t* thread;
+    const mooon::sys::flight_event_t* event;
+
+    bool operator <(const FlightLine& other) const
+    {
+        return event->timestamp_ns < other.event->timestamp_ns;
+    }
+};
+
+static void print_line(const mooon::sys::CFlightReader& reader, const FlightLine& line)
+{
+    fprintf(stdout, "[%s][%u:%s] %s %s\n",
+            reader.get_datetime(line.event->timestamp_ns).c_str(), line.thread->thread_id, line.thread->thread_name.c_str(),
+            reader.get_event_name(line.event->event_id).c_str(), mooon::sys::CFlightReader::format_payload(*line.event).c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+    if (mooon::argument::file->value().empty())
+    {
+        fprintf(stderr, "parameter[--file] is not set\n");
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    try
+    {
+        mooon::sys::CFlightReader reader;
+        reader.open(mooon::argument::file->value());
+        if (0 == reader.get_signo())
+            fprintf(stdout, "pid %u dumped on demand\n", reader.get_pid());
+        else
+            fprintf(stdout, "pid %u dumped on signal %d(%s)\n", reader.get_pid(), reader.get_signo(), strsignal(reader.get_signo()));
+
+        std::vector<FlightLine> lines;
+        const std::vector<mooon::sys::flight_thread_t>& threads = reader.get_threads();
+        for (std::vector<mooon::sys::flight_thread_t>::size_type i=0; i<threads.size(); ++i)
+        {
+            const mooon::sys::flight_thread_t& thread = threads[i];
+            if ((mooon::argument::thread->value() != 0) && (mooon::argument::thread->value() != thread.thread_id))
+                continue;
+
+            if (mooon::argument::merge->is_false())
+                fprintf(stdout, "\nthread %u(%s): %zu of %" PRIu64" events\n",
+                        thread.thread_id, thread.thread_name.c_str(), thread.events.size(), thread.event_number);
+            for (std::vector<mooon::sys::flight_event_t>::size_type j=0; j<thread.events.size(); ++j)
+            {
+                const FlightLine line = { &thread, &thread.events[j] };
+                if (mooon::argument::merge->is_true())
+                    lines.push_back(line);
+                else
+                    print_line(reader, line);
+            }
+        }
+
+        std::stable_sort(lines.begin(), lines.end());
+        for (std::vector<FlightLine>::size_type i=0; i<lines.size(); ++i)
+            print_line(reader, lines[i]);
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    return 0;
+}
@@ -19,15 +19,18 @@
 #include "THBaseService.h"
 #include <mooon/net/thrift_helper.h>
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/event_queue.h>
 #include <mooon/sys/safe_logger.h>
 #include <mooon/sys/stop_watch.h>
 #include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
+#include <mooon/utils/array_queue.h>
 #include <mooon/utils/string_utils.h>
 #include <mooon/utils/tokener.h>
+#include <algorithm>
 
-STRING_ARG_DEFINE(hbase_ip, "127.0.0.1", "hbase thrift server IP");
+STRING_ARG_DEFINE(hbase_ip, "127.0.0.1", "hbase thrift server IP, parallel scan accepts multiple separated by comma");
 INTEGER_ARG_DEFINE(uint16_t, hbase_port, 9090, 1000, 65535, "hbase thrift server port");
 STRING_ARG_DEFINE(table, "test", "hbase table name");
 STRING_ARG_DEFINE(family, "cf1", "hbase column family name");
@@ -39,8 +42,21 @@ INTEGER_ARG_DEFINE(int, timeout, 10, 1, 3600, "timeout seconds of thrift");
 INTEGER_ARG_DEFINE(int, batch_size, 0, 0, 100000, "batch size");
 INTEGER_ARG_DEFINE(int, caching, 0, 0, 100000, "hbase.client.scanner.caching");
 
+// threads大于0时并行扫描：键范围被splits或prefixes切分成多段，各线程以各自的连接和scanner扫描不同的段，
+// 扫到的行经有界队列交给主线程输出，队列满时扫描线程等待，所以内存占用不超过queue_size批
+INTEGER_ARG_DEFINE(int, threads, 0, 0, 1000, "number of parallel scanning threads, 0 to scan sequentially");
+STRING_ARG_DEFINE(splits, "", "row keys separated by comma which split [startrow, stoprow) into ranges, such as the region start keys");
+STRING_ARG_DEFINE(prefixes, "", "row key prefixes separated by comma, each is scanned as a range, startrow and stoprow are ignored");
+STRING_ARG_DEFINE(columns, "", "qualifiers of family separated by comma to return only, empty to return all");
+STRING_ARG_DEFINE(filter, "", "filter string pushed down to region servers, such as: PrefixFilter('abc')");
+INTEGER_ARG_DEFINE(int, queue_size, 100, 1, 100000, "max batches of rows buffered for output");
+
 using namespace apache::hadoop;
 
+static int parallel_scan();
+static void print_result(const hbase::thrift2::TResult& result);
+static std::vector<hbase::thrift2::TColumn> get_columns();
+
 int main(int argc, char* argv[])
 {
     std::string errmsg;
@@ -68,6 +84,10 @@ int main(int argc, char* argv[])
         fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
         exit(1);
     }
+    if (mooon::argument::threads->value() > 0)
+    {
+        return parallel_scan();
+    }
     if (mooon::argument::startrow->value().empty())
     {
         fprintf(stderr, "parameter[--startrow] not set\n");
@@ -118,6 +138,14 @@ int main(int argc, char* argv[])
             {
                 scan.__set_batchSize(mooon::argument::batch_size->value());
             }
+            if (!mooon::argument::columns->value().empty())
+            {
+                scan.__set_columns(get_columns());
+            }
+            if (!mooon::argument::filter->value().empty())
+            {
+                scan.__set_filterString(mooon::argument::filter->value());
+            }
 
             hbase->getScannerResults(results, mooon::argument::table->value(), scan, batch);
             for (std::vector<hbase::thrift2::TResult>::size_type row=0; row<results.size(); ++row)
@@ -129,16 +157,7 @@ int main(int argc, char* argv[])
 
                 const hbase::thrift2::TResult& result = results[row];
                 startrow = result.row;
-                MYLOG_DEBUG("ROWKEY[%s] =>\n", startrow.c_str());
-
-                for (std::vector<hbase::thrift2::TColumnValue>::size_type col=0; col<result.columnValues.size(); ++col)
-                {
-                    const hbase::thrift2::TColumnValue& column = result.columnValues[col];
-                    MYLOG_DEBUG("\tfamily => %s\n", column.family.c_str());
-                    MYLOG_DEBUG("\t\tqualifier => %s\n", column.qualifier.c_str());
-                    MYLOG_DEBUG("\t\t\tvalue => %s\n", column.value.c_str());
-                    MYLOG_DEBUG("\t\t\t\ttimestamp => %" PRId64"\n", column.timestamp);
-                }
+                print_result(result);
             }
 
             if (static_cast<int>(results.size()) < batch)
@@ -168,3 +187,245 @@ int main(int argc, char* argv[])
 
     return 0;
 }
+
+void print_result(const hbase::thrift2::TResult& result)
+{
+    MYLOG_DEBUG("ROWKEY[%s] =>\n", result.row.c_str());
+
+    for (std::vector<hbase::thrift2::TColumnValue>::size_type col=0; col<result.columnValues.size(); ++col)
+    {
+        const hbase::thrift2::TColumnValue& column = result.columnValues[col];
+        MYLOG_DEBUG("\tfamily => %s\n", column.family.c_str());
+        MYLOG_DEBUG("\t\tqualifier => %s\n", column.qualifier.c_str());
+        MYLOG_DEBUG("\t\t\tvalue => %s\n", column.value.c_str());
+        MYLOG_DEBUG("\t\t\t\ttimestamp => %" PRId64"\n", column.timestamp);
+    }
+}
+
+std::vector<hbase::thrift2::TColumn> get_columns()
+{
+    std::vector<std::string> qualifiers;
+    std::vector<hbase::thrift2::TColumn> columns;
+
+    mooon::utils::CTokener::split(&qualifiers, mooon::argument::columns->value(), ",", true);
+    for (std::vector<std::string>::size_type i=0; i<qualifiers.size(); ++i)
+    {
+        hbase::thrift2::TColumn column;
+        column.__set_family(mooon::argument::family->value());
+        column.__set_qualifier(qualifiers[i]);
+        columns.push_back(column);
+    }
+
+    return columns;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 一段键范围[start_row, stop_row)，stop_row为空表示到表尾
+struct KeyRange
+{
+    std::string start_row;
+    std::string stop_row;
+};
+
+typedef mooon::sys::CEventQueue<mooon::utils::CArrayQueue<std::vector<hbase::thrift2::TResult>*> > ResultQueue;
+
+static std::vector<KeyRange> sg_ranges;
+static atomic_t sg_next_range = 0;     // 下一个待扫描的段
+static atomic_t sg_thread_count = 0;   // 仍在扫描的线程数
+static atomic_t sg_failed_ranges = 0;  // 扫描出错的段数
+
+// 以prefix打头的键都小于返回值，prefix全为0xFF时返回空，表示到表尾
+static std::string get_prefix_end(const std::string& prefix)
+{
+    std::string end = prefix;
+
+    while (!end.empty() && (static_cast<unsigned char>(end[end.size()-1]) == 0xFF))
+        end.erase(end.size()-1);
+    if (!end.empty())
+        end[end.size()-1] = static_cast<char>(static_cast<unsigned char>(end[end.size()-1]) + 1);
+    return end;
+}
+
+static void make_ranges()
+{
+    std::vector<std::string> keys;
+
+    if (!mooon::argument::prefixes->value().empty())
+    {
+        mooon::utils::CTokener::split(&keys, mooon::argument::prefixes->value(), ",", true);
+        for (std::vector<std::string>::size_type i=0; i<keys.size(); ++i)
+        {
+            KeyRange range;
+            range.start_row = keys[i];
+            range.stop_row = get_prefix_end(keys[i]);
+            sg_ranges.push_back(range);
+        }
+    }
+    else
+    {
+        // 分割点须在[startrow, stoprow)内并按升序排列
+        mooon::utils::CTokener::split(&keys, mooon::argument::splits->value(), ",", true);
+        std::sort(keys.begin(), keys.end());
+
+        KeyRange range;
+        range.start_row = mooon::argument::startrow->value();
+        for (std::vector<std::string>::size_type i=0; i<keys.size(); ++i)
+        {
+            if ((keys[i] <= range.start_row)
+             || (!mooon::argument::stoprow->value().empty() && (keys[i] >= mooon::argument::stoprow->value())))
+                continue;
+
+            range.stop_row = keys[i];
+            sg_ranges.push_back(range);
+            range.start_row = keys[i];
+        }
+
+        range.stop_row = mooon::argument::stoprow->value();
+        sg_ranges.push_back(range);
+    }
+}
+
+// 扫描完一段再取下一段，扫描出错时放弃该段，由调用者据末尾的统计决定是否重扫
+static void scan_thread(int index, std::string hbase_ip, ResultQueue* queue)
+{
+    const int batch = mooon::argument::batch->value();
+    const int timeout_milliseconds = mooon::argument::timeout->value() * 1000;
+    mooon::net::CThriftClientHelper<hbase::thrift2::THBaseServiceClient> hbase(hbase_ip, mooon::argument::hbase_port->value(), timeout_milliseconds, timeout_milliseconds, timeout_milliseconds);
+
+    for (;;)
+    {
+        const int range_index = atomic_inc_return(&sg_next_range) - 1;
+        if (range_index >= static_cast<int>(sg_ranges.size()))
+            break;
+
+        const KeyRange& range = sg_ranges[range_index];
+        int64_t rows = 0;
+        try
+        {
+            hbase::thrift2::TScan scan;
+            if (!range.start_row.empty())
+                scan.__set_startRow(range.start_row);
+            if (!range.stop_row.empty())
+                scan.__set_stopRow(range.stop_row);
+            if (mooon::argument::caching->value() > 0)
+                scan.__set_caching(mooon::argument::caching->value());
+            if (mooon::argument::batch_size->value() > 0)
+                scan.__set_batchSize(mooon::argument::batch_size->value());
+            if (!mooon::argument::columns->value().empty())
+                scan.__set_columns(get_columns());
+            if (!mooon::argument::filter->value().empty())
+                scan.__set_filterString(mooon::argument::filter->value());
+
+            if (!hbase.is_connected())
+                hbase.connect();
+            const int32_t scanner_id = hbase->openScanner(mooon::argument::table->value(), scan);
+            for (;;)
+            {
+                std::vector<hbase::thrift2::TResult>* results = new std::vector<hbase::thrift2::TResult>;
+                hbase->getScannerRows(*results, scanner_id, batch);
+                if (results->empty())
+                {
+                    delete results;
+                    break;
+                }
+
+                // 队列满时等待主线程取走，即反压
+                rows += static_cast<int64_t>(results->size());
+                while (!queue->push_back(results));
+            }
+
+            hbase->closeScanner(scanner_id);
+            MYLOG_INFO("[%d] range[%d] [%s, %s) finished: %" PRId64"\n", index, range_index, range.start_row.c_str(), range.stop_row.c_str(), rows);
+        }
+        catch (hbase::thrift2::TIOError& ex)
+        {
+            atomic_inc(&sg_failed_ranges);
+            MYLOG_ERROR("[%d] range[%d] [%s, %s) after %" PRId64" rows: %s\n", index, range_index, range.start_row.c_str(), range.stop_row.c_str(), rows, ex.message.c_str());
+        }
+        catch (apache::thrift::transport::TTransportException& ex)
+        {
+            atomic_inc(&sg_failed_ranges);
+            MYLOG_ERROR("[%d] range[%d] [%s, %s) after %" PRId64" rows: (%d)%s\n", index, range_index, range.start_row.c_str(), range.stop_row.c_str(), rows, ex.getType(), ex.what());
+            hbase.close();
+        }
+        catch (apache::thrift::TException& ex)
+        {
+            atomic_inc(&sg_failed_ranges);
+            MYLOG_ERROR("[%d] range[%d] [%s, %s) after %" PRId64" rows: %s\n", index, range_index, range.start_row.c_str(), range.stop_row.c_str(), rows, ex.what());
+        }
+    }
+
+    atomic_dec(&sg_thread_count);
+}
+
+int parallel_scan()
+{
+    std::vector<std::string> hbase_ips;
+    mooon::utils::CTokener::split(&hbase_ips, mooon::argument::hbase_ip->value(), ",", true);
+    if (hbase_ips.empty())
+    {
+        fprintf(stderr, "parameter[--hbase_ip] not set\n");
+        return 1;
+    }
+
+    make_ranges();
+    try
+    {
+        mooon::sys::g_logger = mooon::sys::create_safe_logger("/tmp", "hbase_scan.log");
+        mooon::sys::g_logger->set_backup_number(2);
+        mooon::sys::g_logger->set_single_filesize(1024*1024);
+
+        mooon::sys::CStopWatch stop_watch;
+        const int threads = std::min(mooon::argument::threads->value(), static_cast<int>(sg_ranges.size()));
+        ResultQueue queue(mooon::argument::queue_size->value(), 1000, 1000);
+        std::vector<mooon::sys::CThreadEngine*> scan_threads(threads);
+        MYLOG_INFO("scanning %d ranges by %d threads\n", static_cast<int>(sg_ranges.size()), threads);
+
+        atomic_set(&sg_thread_count, threads);
+        for (int i=0; i<threads; ++i)
+        {
+            scan_threads[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(scan_thread, i, hbase_ips[i%hbase_ips.size()], &queue));
+        }
+
+        // 所有扫描线程结束，并且队列已空时结束
+        int64_t total = 0;
+        for (;;)
+        {
+            const bool finished = (0 == atomic_read(&sg_thread_count));
+            std::vector<hbase::thrift2::TResult>* results;
+            if (!queue.pop_front(results))
+            {
+                if (finished)
+                    break;
+                continue;
+            }
+
+            for (std::vector<hbase::thrift2::TResult>::size_type row=0; row<results->size(); ++row)
+            {
+                if (0 == ++total%10000)
+                {
+                    MYLOG_INFO("[%" PRId64"] %s\n", total, (*results)[row].row.c_str());
+                }
+                print_result((*results)[row]);
+            }
+            delete results;
+        }
+
+        for (int i=0; i<threads; ++i)
+        {
+            scan_threads[i]->join();
+            delete scan_threads[i];
+        }
+
+        const unsigned int milliseconds = stop_watch.get_elapsed_microseconds() / 1000;
+        MYLOG_INFO("[FINISH] number of rows: %" PRId64", failed ranges: %d, milliseconds: %u, rows per second: %" PRId64"\n",
+                   total, static_cast<int>(atomic_read(&sg_failed_ranges)), milliseconds, (0 == milliseconds)? total: total*1000/milliseconds);
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    return (0 == atomic_read(&sg_failed_ranges))? 0: 1;
+}
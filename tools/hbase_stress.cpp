@@ -19,11 +19,14 @@
 #include "THBaseService.h"
 #include <mooon/net/thrift_helper.h>
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/metrics.h>
 #include <mooon/sys/safe_logger.h>
 #include <mooon/sys/stop_watch.h>
 #include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
+#include <mooon/utils/scoped_ptr.h>
 #include <mooon/utils/string_utils.h>
 #include <mooon/utils/tokener.h>
 
@@ -38,15 +41,27 @@ INTEGER_ARG_DEFINE(uint16_t, value_length, 10, 1, std::numeric_limits<uint16_t>:
 INTEGER_ARG_DEFINE(uint16_t, timeout, 10, 1, std::numeric_limits<uint16_t>::max(), "timeout seconds of thrift");
 INTEGER_ARG_DEFINE(uint8_t, test, 2, 0, 2, "0: test all, 1: test write only, 2: test read onley");
 
+// batch或pipeline大于1时，所有线程共用一个连接池，调用在各thrift节点间按未应答数最少分摊，
+// 每次借一个连接，连续发出pipeline个putMultiple或getMultiple（每个batch行）后再依次接收应答
+INTEGER_ARG_DEFINE(uint16_t, batch, 1, 1, 10000, "rows of each putMultiple or getMultiple, 1 to put or get a row each call");
+INTEGER_ARG_DEFINE(uint16_t, pipeline, 1, 1, 1000, "calls sent on a connection before receiving their replies");
+INTEGER_ARG_DEFINE(uint16_t, connections, 4, 1, 1000, "max connections to each thrift node of the pool shared by all threads");
+
+typedef apache::hadoop::hbase::thrift2::THBaseServiceClient hbase_client_t;
+typedef mooon::net::CThriftClientPool<hbase_client_t> hbase_pool_t;
+
 static atomic_t sg_success_count = 0;
 static atomic_t sg_failure_count = 0;
 static atomic_t sg_empty_count = 0; // 读操作未取到数据的个数
 static atomic_t sg_thread_count = 0; // 当前仍然在工作的线程数
+static mooon::sys::CLatencyHistogram sg_call_histogram; // 每次调用（一行或一批）的耗时
 
 static void test_write(const std::map<std::string, std::string>& hbase_nodes);
 static void test_read(const std::map<std::string, std::string>& hbase_nodes);
 static void write_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port);
 static void read_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port);
+static void batch_thread(uint16_t index, hbase_pool_t* client_pool, bool is_write);
+static bool is_batch_mode() { return (mooon::argument::batch->value() > 1) || (mooon::argument::pipeline->value() > 1); }
 
 int main(int argc, char* argv[])
 {
@@ -91,6 +106,29 @@ std::string get_rowkey(uint32_t row, int index)
         return mooon::utils::CStringUtils::format_string("%s_%u%u%d", mooon::argument::prefix->c_value(), random_number, row, index);
 }
 
+// 所有线程共用的连接池，连接失败的节点10秒内不再选中
+static hbase_pool_t* new_client_pool(const std::map<std::string, std::string>& hbase_nodes)
+{
+    std::vector<std::pair<std::string, int> > servers;
+    for (std::map<std::string, std::string>::const_iterator iter=hbase_nodes.begin(); iter!=hbase_nodes.end(); ++iter)
+        servers.push_back(std::make_pair(iter->first, mooon::utils::CStringUtils::string2int<int>(iter->second)));
+
+    const int timeout_milliseconds = mooon::argument::timeout->value() * 1000;
+    return new hbase_pool_t(servers, mooon::argument::connections->value(), timeout_milliseconds, timeout_milliseconds, timeout_milliseconds);
+}
+
+// 输出并清零每次调用的耗时分布
+static void print_latency()
+{
+    mooon::sys::CHistogramSnapshot snapshot;
+    sg_call_histogram.get_snapshot(&snapshot, true);
+    MYLOG_INFO("calls: %" PRIu64", rows per call: %u, pipeline: %u\n", snapshot.get_count(),
+               static_cast<unsigned int>(mooon::argument::batch->value()), static_cast<unsigned int>(mooon::argument::pipeline->value()));
+    MYLOG_INFO("latency(us): mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+               snapshot.get_mean()/1000.0, snapshot.get_percentile(50)/1000.0, snapshot.get_percentile(90)/1000.0,
+               snapshot.get_percentile(99)/1000.0, snapshot.get_percentile(99.9)/1000.0, snapshot.get_max()/1000.0);
+}
+
 void test_write(const std::map<std::string, std::string>& hbase_nodes)
 {
     try
@@ -98,9 +136,16 @@ void test_write(const std::map<std::string, std::string>& hbase_nodes)
         mooon::sys::CStopWatch stop_watch;
         mooon::sys::CThreadEngine** stress_threads = new mooon::sys::CThreadEngine*[mooon::argument::threads->value()];
 
+        mooon::utils::ScopedPtr<hbase_pool_t> client_pool(is_batch_mode()? new_client_pool(hbase_nodes): NULL);
         atomic_set(&sg_thread_count, mooon::argument::threads->value());
         for (uint16_t i=0,j=0; i<mooon::argument::threads->value(); ++i,++j)
         {
+            if (is_batch_mode())
+            {
+                stress_threads[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(batch_thread, i, client_pool.get(), true));
+                continue;
+            }
+
             if (j >= hbase_nodes.size())
                 j = 0;
             std::map<std::string, std::string>::const_iterator iter = hbase_nodes.begin();
@@ -127,6 +172,7 @@ void test_write(const std::map<std::string, std::string>& hbase_nodes)
         MYLOG_INFO("seconds: %u, milliseconds: %u\n", seconds, milliseconds);
         MYLOG_INFO("SUCCESS: %u, FAILURE: %u\n", success, failure);
         MYLOG_INFO("QPS: %u, %u\n", qps, qps/mooon::argument::threads->value());
+        print_latency();
     }
     catch (mooon::sys::CSyscallException& ex)
     {
@@ -141,9 +187,16 @@ void test_read(const std::map<std::string, std::string>& hbase_nodes)
         mooon::sys::CStopWatch stop_watch;
         mooon::sys::CThreadEngine** stress_threads = new mooon::sys::CThreadEngine*[mooon::argument::threads->value()];
 
+        mooon::utils::ScopedPtr<hbase_pool_t> client_pool(is_batch_mode()? new_client_pool(hbase_nodes): NULL);
         atomic_set(&sg_thread_count, mooon::argument::threads->value());
         for (uint16_t i=0,j=0; i<mooon::argument::threads->value(); ++i,++j)
         {
+            if (is_batch_mode())
+            {
+                stress_threads[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(batch_thread, i, client_pool.get(), false));
+                continue;
+            }
+
             if (j >= hbase_nodes.size())
                 j = 0;
             std::map<std::string, std::string>::const_iterator iter = hbase_nodes.begin();
@@ -171,6 +224,7 @@ void test_read(const std::map<std::string, std::string>& hbase_nodes)
         MYLOG_INFO("seconds: %u, milliseconds: %u\n", seconds, milliseconds);
         MYLOG_INFO("SUCCESS: %u, FAILURE: %u, EMPTY: %u\n", success, failure, empty);
         MYLOG_INFO("QPS: %u, %u\n", qps, qps/mooon::argument::threads->value());
+        print_latency();
     }
     catch (mooon::sys::CSyscallException& ex)
     {
@@ -178,6 +232,36 @@ void test_read(const std::map<std::string, std::string>& hbase_nodes)
     }
 }
 
+static void make_put(apache::hadoop::hbase::thrift2::TPut* put, const std::string& rowkey)
+{
+    std::vector<apache::hadoop::hbase::thrift2::TColumnValue> columns_value(mooon::argument::num_columns->value());
+    for (uint8_t col=0; col<mooon::argument::num_columns->value(); ++col)
+    {
+        const std::string column_name = mooon::utils::CStringUtils::format_string("field%d", col);
+        const std::string column_value(mooon::argument::value_length->value(), '#');
+        columns_value[col].__set_family("cf1");
+        columns_value[col].__set_qualifier(column_name);
+        columns_value[col].__set_value(column_value);
+    }
+
+    put->__set_row(rowkey);
+    put->__set_columnValues(columns_value);
+}
+
+static void make_get(apache::hadoop::hbase::thrift2::TGet* input, const std::string& rowkey)
+{
+    std::vector<apache::hadoop::hbase::thrift2::TColumn> columns(mooon::argument::num_columns->value());
+    for (uint8_t col=0; col<mooon::argument::num_columns->value(); ++col)
+    {
+        const std::string column_name = mooon::utils::CStringUtils::format_string("field%d", col);
+        columns[col].__set_family("cf1");
+        columns[col].__set_qualifier(column_name);
+    }
+
+    input->__set_row(rowkey);
+    input->__set_columns(columns);
+}
+
 void write_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port)
 {
     mooon::net::CThriftClientHelper<apache::hadoop::hbase::thrift2::THBaseServiceClient> hbase(hbase_ip, hbase_port, mooon::argument::timeout->value()*1000, mooon::argument::timeout->value()*1000, mooon::argument::timeout->value()*1000);
@@ -185,20 +269,8 @@ void write_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port)
     for (uint32_t row=0; row<mooon::argument::num_rows->value(); ++row)
     {
         const std::string rowkey = get_rowkey(row, index);
-
-        std::vector<apache::hadoop::hbase::thrift2::TColumnValue> columns_value(mooon::argument::num_columns->value());
-        for (uint8_t col=0; col<mooon::argument::num_columns->value(); ++col)
-        {
-            const std::string column_name = mooon::utils::CStringUtils::format_string("field%d", col);
-            const std::string column_value(mooon::argument::value_length->value(), '#');
-            columns_value[col].__set_family("cf1");
-            columns_value[col].__set_qualifier(column_name);
-            columns_value[col].__set_value(column_value);
-        }
-
         apache::hadoop::hbase::thrift2::TPut put;
-        put.__set_row(rowkey);
-        put.__set_columnValues(columns_value);
+        make_put(&put, rowkey);
 
         bool to_continue = true;
         while (true)
@@ -210,7 +282,9 @@ void write_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port)
                 if (!hbase.is_connected())
                     hbase.connect();
 
+                const uint64_t start_nanoseconds = mooon::sys::CClock::get_nanoseconds();
                 hbase->put(mooon::argument::table->value(), put);
+                sg_call_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_nanoseconds);
                 //const time_t end = time(NULL);
                 //atomic_inc(&sg_success_count);
 				const uint32_t success_count = static_cast<uint32_t>(atomic_add_return(1, &sg_success_count));
@@ -260,16 +334,7 @@ void read_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port)
     {
         const std::string rowkey = get_rowkey(row, index);
         apache::hadoop::hbase::thrift2::TGet input;
-        input.__set_row(rowkey);
-
-        std::vector<apache::hadoop::hbase::thrift2::TColumn> columns(mooon::argument::num_columns->value());
-        for (uint8_t col=0; col<mooon::argument::num_columns->value(); ++col)
-        {
-            const std::string column_name = mooon::utils::CStringUtils::format_string("field%d", col);
-            columns[col].__set_family("cf1");
-            columns[col].__set_qualifier(column_name);
-        }
-        input.__set_columns(columns);
+        make_get(&input, rowkey);
 
         bool to_continue = true;
         while (true)
@@ -280,7 +345,9 @@ void read_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port)
                     hbase.connect();
 
                 apache::hadoop::hbase::thrift2::TResult result;
+                const uint64_t start_nanoseconds = mooon::sys::CClock::get_nanoseconds();
                 hbase->get(result, mooon::argument::table->value(), input);
+                sg_call_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_nanoseconds);
 
                 const std::vector<apache::hadoop::hbase::thrift2::TColumnValue>& columns_value = result.columnValues;
                 if (columns_value.empty())
@@ -334,3 +401,114 @@ void read_thread(uint16_t index, std::string hbase_ip, uint16_t hbase_port)
     MYLOG_INFO("read thread[%u] ended: %d\n", static_cast<unsigned int>(pthread_self()), static_cast<int>(atomic_read(&sg_thread_count)));
 }
 
+
+// 以连接池批量读写，每轮借一个连接，连续发出最多pipeline个调用后依次接收，
+// TTransportException时该连接被关闭，未应答的调用计为失败，其它异常时结束本线程
+void batch_thread(uint16_t index, hbase_pool_t* client_pool, bool is_write)
+{
+    const uint32_t num_rows = mooon::argument::num_rows->value();
+    const uint16_t batch = mooon::argument::batch->value();
+    const uint16_t pipeline = mooon::argument::pipeline->value();
+    std::vector<std::vector<apache::hadoop::hbase::thrift2::TPut> > puts(pipeline);
+    std::vector<std::vector<apache::hadoop::hbase::thrift2::TGet> > gets(pipeline);
+    std::vector<apache::hadoop::hbase::thrift2::TResult> results;
+    std::vector<uint64_t> start_nanoseconds(pipeline);
+    bool to_continue = true;
+
+    for (uint32_t row=0; to_continue && (row<num_rows);)
+    {
+        uint16_t calls = 0;
+        for (; (calls<pipeline) && (row<num_rows); ++calls)
+        {
+            puts[calls].clear();
+            gets[calls].clear();
+            for (uint16_t i=0; (i<batch) && (row<num_rows); ++i, ++row)
+            {
+                const std::string rowkey = get_rowkey(row, index);
+                if (is_write)
+                {
+                    puts[calls].push_back(apache::hadoop::hbase::thrift2::TPut());
+                    make_put(&puts[calls].back(), rowkey);
+                }
+                else
+                {
+                    gets[calls].push_back(apache::hadoop::hbase::thrift2::TGet());
+                    make_get(&gets[calls].back(), rowkey);
+                }
+            }
+        }
+
+        mooon::net::ThriftClientPoolHelper<hbase_client_t> hbase(client_pool);
+        uint16_t received = 0;
+        if (!hbase.ok())
+        {
+            MYLOG_ERROR("no connection available: %s\n", mooon::argument::hbase->c_value());
+            for (uint16_t j=0; j<calls; ++j)
+                atomic_add(static_cast<int>(is_write? puts[j].size(): gets[j].size()), &sg_failure_count);
+            mooon::sys::CUtils::millisleep(1000);
+            continue;
+        }
+
+        client_pool->add_outstanding(hbase.get(), calls-1);
+        try
+        {
+            for (uint16_t j=0; j<calls; ++j)
+            {
+                start_nanoseconds[j] = mooon::sys::CClock::get_nanoseconds();
+                if (is_write)
+                    hbase->send_putMultiple(mooon::argument::table->value(), puts[j]);
+                else
+                    hbase->send_getMultiple(mooon::argument::table->value(), gets[j]);
+            }
+            for (; received<calls; ++received)
+            {
+                int rows;
+                if (is_write)
+                {
+                    hbase->recv_putMultiple();
+                    rows = static_cast<int>(puts[received].size());
+                }
+                else
+                {
+                    hbase->recv_getMultiple(results);
+                    rows = 0;
+                    for (std::vector<apache::hadoop::hbase::thrift2::TResult>::size_type k=0; k<results.size(); ++k)
+                    {
+                        if (results[k].columnValues.empty())
+                            atomic_inc(&sg_empty_count);
+                        else
+                            ++rows;
+                    }
+                }
+                sg_call_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_nanoseconds[received]);
+
+                const uint32_t success_count = static_cast<uint32_t>(atomic_add_return(rows, &sg_success_count));
+                if (success_count/10000 != (success_count-rows)/10000)
+                    MYLOG_INFO("number of %s: %u\n", is_write? "write": "read", success_count);
+            }
+        }
+        catch (apache::thrift::transport::TTransportException& ex)
+        {
+            MYLOG_ERROR("TransportException(%s): %s\n", hbase.get()->str().c_str(), ex.what());
+            hbase.set_broken();
+        }
+        catch (apache::thrift::TApplicationException& ex)
+        {
+            MYLOG_ERROR("ApplicationException(%s): %s\n", hbase.get()->str().c_str(), ex.what());
+            to_continue = false;
+        }
+        catch (apache::thrift::TException& ex)
+        {
+            MYLOG_ERROR("ThriftException(%s): %s\n", hbase.get()->str().c_str(), ex.what());
+            to_continue = false;
+        }
+        client_pool->add_outstanding(hbase.get(), -(calls-1));
+
+        // 未收到应答的计为失败
+        for (uint16_t j=received; j<calls; ++j)
+            atomic_add(static_cast<int>(is_write? puts[j].size(): gets[j].size()), &sg_failure_count);
+    }
+
+    atomic_dec(&sg_thread_count);
+    MYLOG_INFO("%s thread[%u] ended: %d\n", is_write? "write": "read", static_cast<unsigned int>(index), static_cast<int>(atomic_read(&sg_thread_count)));
+}
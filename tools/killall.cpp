@@ -1,5 +1,7 @@
 // Writed by yijian on 2018/10/19
+#include <mooon/sys/process_table.h>
 #include <mooon/sys/utils.h>
+#include <mooon/utils/exception.h>
 #include <mooon/utils/string_utils.h>
 
 // argv[1] process name
@@ -26,24 +28,36 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    // 第3个参数
     if (4 == argc)
     {
-        fprintf(stderr, "Usage: %s pname signo [0|1]\n", mooon::sys::CUtils::get_program_short_name().c_str());
-        exit(1);
+        if (0 == strcmp(argv[3], "0"))
+            regex = false;
+        else if (0 == strcmp(argv[3], "1"))
+            regex = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s pname signo [0|1]\n", mooon::sys::CUtils::get_program_short_name().c_str());
+            exit(1);
+        }
     }
 
-    // 第3个参数
-    if (0 == strcmp(argv[3], "0"))
-        regex = false;
-    else if (0 == strcmp(argv[3], "1"))
-        regex = true;
-    else
+    try
     {
-        fprintf(stderr, "Usage: %s pname signo [0|1]\n", mooon::sys::CUtils::get_program_short_name().c_str());
+        mooon::sys::CProcessNameFilter filter(process_name, regex);
+        mooon::sys::CProcessTable process_table;
+        std::vector<int64_t> pid_array;
+
+        process_table.scan(mooon::sys::CProcessTable::PROCESS_STAT, 0, &filter);
+        process_table.get_pids(&pid_array);
+
+        const int success = mooon::sys::CUtils::killall(pid_array, signo);
+        fprintf(stdout, "SUCCESS: %d, FAILURE: %d\n", success, static_cast<int>(pid_array.size())-success);
+        return 0;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
         exit(1);
     }
-
-    const std::pair<int, int> ret = mooon::sys::CUtils::killall(process_name, signo, regex);
-    fprintf(stdout, "SUCCESS: %d, FAILURE: %d\n", ret.first, ret.second);
-    return 0;
 }
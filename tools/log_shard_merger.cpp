@@ -0,0 +1,67 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 分片日志合并工具，将CSafeLogger以分片方式写的日志按时间合并输出到标准输出，示例：
+// log_shard_merger --dir=/data/log --file=test.log > test.merged.log
+#include <mooon/sys/log_shard_merger.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/utils/args_parser.h>
+#include <stdio.h>
+
+STRING_ARG_DEFINE(dir, ".", "log directory");
+STRING_ARG_DEFINE(file, "", "log filename, e.g. test.log");
+BOOL_STRING_ARG_DEFINE(timestamp, "false", "prefix each line with its nanosecond timestamp");
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+    if (mooon::argument::file->value().empty())
+    {
+        fprintf(stderr, "parameter[--file] is not set\n");
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    try
+    {
+        mooon::sys::CLogShardMerger merger(mooon::argument::dir->value(), mooon::argument::file->value());
+        const bool print_timestamp = mooon::argument::timestamp->is_true();
+        std::string log_line;
+        uint64_t timestamp;
+
+        while (merger.next(&log_line, &timestamp))
+        {
+            if (print_timestamp)
+                fprintf(stdout, "%" PRIu64" ", timestamp);
+            fwrite(log_line.data(), log_line.size(), 1, stdout);
+        }
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    return 0;
+}
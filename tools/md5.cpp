@@ -16,9 +16,13 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <mooon/sys/file_utils.h>
 #include <mooon/utils/md5_helper.h>
 #include <mooon/utils/charset_utils.h>
 
+// md5 string：对字符串求MD5
+// md5 -f filepath：对文件求MD5，同md5sum
+// md5 -t filepath [chunk_mb] [threads]：多线程分块求文件的树形MD5，结果不同于md5sum
 int main(int argc, char* argv[])
 {
     std::string md5;
@@ -26,8 +30,34 @@ int main(int argc, char* argv[])
     if (argc < 2)
     {
         fprintf(stderr, "usage: md5 string\n");
+        fprintf(stderr, "       md5 -f filepath\n");
+        fprintf(stderr, "       md5 -t filepath [chunk_mb] [threads]\n");
         exit(1);
     }
+    else if (((0 == strcmp(argv[1], "-f")) || (0 == strcmp(argv[1], "-t"))) && (argc > 2))
+    {
+        try
+        {
+            if (0 == strcmp(argv[1], "-f"))
+            {
+                (void)mooon::sys::CFileUtils::md5sum(&md5, argv[2]);
+            }
+            else
+            {
+                const size_t chunk_mb = (argc > 3)? static_cast<size_t>(atoi(argv[3])): 64;
+                const int threads = (argc > 4)? atoi(argv[4]): 4;
+                (void)mooon::sys::CFileUtils::tree_md5sum(&md5, argv[2], chunk_mb*1024*1024, threads);
+            }
+
+            printf("%s  %s\n", md5.c_str(), argv[2]);
+            return 0;
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            fprintf(stderr, "%s\n", ex.str().c_str());
+            exit(1);
+        }
+    }
     else
     {
         md5 = mooon::utils::CMd5Helper::lowercase_md5("%s", argv[1]);
@@ -25,10 +25,21 @@
 // ./mooon_download -h=192.168.10.11 -p=6000 -u=root -P='root123' -s=/etc/hosts,/etc/passwd -d=/tmp/
 // 表示将192.168.10.11机器上的文件/etc/hosts和/etc/passwd两个文件下载到本地的/tmp目录下
 //
+// 默认以SFTP在一个会话上同时下载多个文件（--parallel指定同时下载的文件数），
+// --sftp=false时改用SCP，每个文件一个会话，依次下载
+//
+// -h可指定多台主机，以逗号分隔，--thr指定同时下载的主机数，
+// 多台主机时每台主机的文件下载到目录-d下以其IP命名的子目录中，如/tmp/192.168.10.11/hosts，
+// --resume=true时续传：本地文件不比远端的大时，从本地文件的大小处接着下载（只对SFTP有效），
+// --progress指定报告每个文件下载进度的间隔秒数
+//
 // 可环境变量H替代参数“-h”
 // 可环境变量U替代参数“-u”
 // 可环境变量P替代参数“-p”
 #include "mooon/net/libssh2.h"
+#include "mooon/sys/clock.h"
+#include "mooon/sys/dir_utils.h"
+#include "mooon/sys/thread_engine.h"
 #include "mooon/sys/stop_watch.h"
 #include "mooon/utils/args_parser.h"
 #include "mooon/utils/print_color.h"
@@ -36,6 +47,7 @@
 #include "mooon/utils/tokener.h"
 #include <fstream>
 #include <iostream>
+#include <map>
 
 // 逗号分隔的远程主机IP列表
 STRING_ARG_DEFINE(h, "", "Connect to the remote machines on the given hosts separated by comma, can be replaced by environment variable 'H', example: -h='192.168.1.10,192.168.1.11'");
@@ -53,41 +65,108 @@ STRING_ARG_DEFINE(s, "", "The remote source files downloaded, separated by comma
 // 文件上传后存放的目录路径
 STRING_ARG_DEFINE(d, "", "The local destination directory, example: -d='/tmp/'");
 
+// 是否以SFTP下载
+BOOL_STRING_ARG_DEFINE(sftp, "true", "Download by SFTP over one session with pipelined reads, or by SCP with one session per file if false");
+// SFTP同时下载的文件数
+INTEGER_ARG_DEFINE(uint16_t, parallel, 8, 1, 256, "The number of files downloaded at the same time by SFTP");
+// SFTP每个文件每次读的字节数，拆分为多个同时在途的读请求
+INTEGER_ARG_DEFINE(uint32_t, buffer_size, 1048576, 32768, 67108864, "The number of bytes read at a time per file by SFTP, split into pipelined requests");
+// 同时下载的主机数
+INTEGER_ARG_DEFINE(int, thr, 1, 0, 2018, "The number of threads to parallel download from hosts (0: number of hosts), can be replaced by environment variable 'THR'");
+// 是否续传
+BOOL_STRING_ARG_DEFINE(resume, "false", "Resume partially downloaded files from the size of the local file if it is not larger than the remote (SFTP only)");
+// 报告进度的间隔，单位为秒
+INTEGER_ARG_DEFINE(uint16_t, progress, 0, 0, 3600, "The number of seconds between progress reports of each file by SFTP (0: no progress report)");
+
 // 结果信息
 struct ResultInfo
 {
     bool success; // 为true表示执行成功
     std::string ip; // 远程host的IP地址
     std::string source; // 被下载的文件
-    uint32_t seconds; // 运行花费的时长，精确到秒
+    int64_t num_bytes; // 本次下载的字节数，不含续传前已有的
+    uint32_t milliseconds; // 运行花费的时长，精确到毫秒
 
     ResultInfo()
-        : success(false), seconds(0)
+        : success(false), num_bytes(0), milliseconds(0)
     {
     }
 
     std::string str() const
     {
         std::string tag = success? "SUCCESS": "FAILURE";
-        return mooon::utils::CStringUtils::format_string("[%s %s]: %u seconds (%s)", ip.c_str(), tag.c_str(), seconds, source.c_str());
+        return mooon::utils::CStringUtils::format_string("[%s %s]: %" PRId64" bytes, %u milliseconds (%s)", ip.c_str(), tag.c_str(), num_bytes, milliseconds, source.c_str());
     }
 };
 
+// 每秒下载的MB数
+static double get_throughput(int64_t num_bytes, uint64_t milliseconds)
+{
+    return (0 == milliseconds)? 0.0: (static_cast<double>(num_bytes) / (1024*1024)) / (static_cast<double>(milliseconds) / 1000);
+}
+
 inline std::ostream& operator <<(std::ostream& out, const struct ResultInfo& result)
 {
     std::string tag = result.success? "SUCCESS": "FAILURE";
-    out << "[" PRINT_COLOR_YELLOW << result.ip << PRINT_COLOR_NONE" " << tag << "] " << result.seconds << " seconds (" << result.source << ")";
+    out << "[" PRINT_COLOR_YELLOW << result.ip << PRINT_COLOR_NONE" " << tag << "] "
+        << result.num_bytes << " bytes, " << result.milliseconds << " milliseconds, "
+        << mooon::utils::CStringUtils::format_string("%.2f", get_throughput(result.num_bytes, result.milliseconds)) << " MB/s (" << result.source << ")";
     return out;
 }
 
+// 从一台主机下载的参数，同一主机的结果在results中是连续的
+struct DownloadTask
+{
+    std::string ip;
+    std::string directory; // 下载到的本地目录，多台主机时为每台主机一个子目录
+    bool create_directory; // 是否须先创建directory
+    uint16_t port;
+    std::string user;
+    std::string password;
+    const std::vector<std::string>* source_files;
+    struct ResultInfo* results;
+};
+
+// SFTP下载的进度回调的参数
+struct ProgressContext
+{
+    const std::string* ip;
+    uint64_t start_nanoseconds; // 开始下载的时间
+    std::map<const void*, uint64_t> report_nanoseconds; // 各文件上次报告的时间
+};
+
 // 命令行参数脱敏处理
 static void escape_args(int argc, char* argv[]);
 
+// 得到同时下载的线程数
+static int get_num_of_threads(int num_hosts);
+
+// 从一台主机下载所有文件
+static void mooon_download(const struct DownloadTask& task);
+
+// 按间隔报告SFTP下载的进度
+static void report_progress(const struct mooon::net::CLibssh2::SftpTransfer& transfer, bool finished, void* context);
+
+// 一个线程依次从分配给它的主机下载，同mooon_upload
+class CDownloadThread
+{
+public:
+    CDownloadThread(int index) { _index = index; }
+    void add_task(const struct DownloadTask& task) { _tasks.push_back(task); }
+    void run();
+
+private:
+    int _index;
+    std::vector<struct DownloadTask> _tasks;
+};
+
 // 可环境变量H替代参数“-h”
 // 可环境变量U替代参数“-u”
 // 可环境变量P替代参数“-p”
 int main(int argc, char* argv[])
 {
+    int num_failure = 0; // 失败的个数
+
 #if MOOON_HAVE_LIBSSH2 == 1
     // 解析命令行参数
     std::string errmsg;
@@ -111,15 +190,14 @@ int main(int argc, char* argv[])
     uint16_t port = mooon::argument::P->value();
     std::string sources = mooon::argument::s->value();
     std::string directory = mooon::argument::d->value();
-    std::string host = mooon::argument::h->value();
+    std::string hosts = mooon::argument::h->value();
     std::string user = mooon::argument::u->value();
     std::string password = mooon::argument::p->value();
     mooon::utils::CStringUtils::trim(sources);
     mooon::utils::CStringUtils::trim(directory);
-    mooon::utils::CStringUtils::trim(host);
+    mooon::utils::CStringUtils::trim(hosts);
     mooon::utils::CStringUtils::trim(user);
     mooon::utils::CStringUtils::trim(password);
-
     // 检查参数（-P）
     const char* port_ = getenv("PORT");
     if (port_ != NULL)
@@ -145,20 +223,20 @@ int main(int argc, char* argv[])
     }
 
     // 检查参数（-h）
-    if (host.empty())
+    if (hosts.empty())
     {
         // 尝试从环境变量取值
-        const char* host_ = getenv("H");
-        if (NULL == host_)
+        const char* hosts_ = getenv("H");
+        if (NULL == hosts_)
         {
             fprintf(stderr, "parameter[-h]'s or environment `H` not set\n\n");
             fprintf(stderr, "%s\n", mooon::utils::CArgumentContainer::get_singleton()->usage_string().c_str());
             exit(1);
         }
 
-        host = host_;
-        mooon::utils::CStringUtils::trim(host);
-        if (host.empty())
+        hosts = hosts_;
+        mooon::utils::CStringUtils::trim(hosts);
+        if (hosts.empty())
         {
             fprintf(stderr, "parameter[-h] or environment `H` not set\n\n");
             fprintf(stderr, "%s\n", mooon::utils::CArgumentContainer::get_singleton()->usage_string().c_str());
@@ -209,76 +287,84 @@ int main(int argc, char* argv[])
         }
     }
 
+    std::vector<std::string> hosts_ip;
+    const int num_hosts = mooon::utils::CTokener::split(&hosts_ip, hosts, ",", true);
     std::vector<std::string> source_files;
     const int num_source_files = mooon::utils::CTokener::split(&source_files, sources, ",", true);
 
-    mooon::net::CLibssh2::init();
-    std::vector<struct ResultInfo> results(num_source_files);
-    for (int j=0; j<num_source_files; ++j)
+    // 多台主机时每台主机下载到以其IP命名的子目录，避免同名文件相互覆盖
+    std::vector<struct ResultInfo> results(num_hosts * num_source_files);
+    std::vector<struct DownloadTask> tasks(num_hosts);
+    for (int i=0; i<num_hosts; ++i)
     {
-        bool color = true;
-
-        std::string local_filepath = directory + std::string("/") + mooon::utils::CStringUtils::extract_filename(source_files[j]);
-        results[j].ip = host;
-        results[j].source = source_files[j];
-        results[j].success = false;
+        struct DownloadTask& task = tasks[i];
+        task.ip = hosts_ip[i];
+        task.directory = (1 == num_hosts)? directory: (directory + std::string("/") + hosts_ip[i]);
+        task.create_directory = (num_hosts > 1);
+        task.port = port;
+        task.user = user;
+        task.password = password;
+        task.source_files = &source_files;
+        task.results = &results[i * num_source_files];
+
+        for (int j=0; j<num_source_files; ++j)
+        {
+            task.results[j].ip = task.ip;
+            task.results[j].source = source_files[j];
+        }
+    }
 
-        std::ofstream local_fs(local_filepath.c_str(), std::ios_base::out|std::ios::binary|std::ios::trunc);
-        if (!local_fs)
+    mooon::sys::CStopWatch stop_watch;
+    mooon::net::CLibssh2::init();
+    const int num_threads = get_num_of_threads(num_hosts);
+    if (num_threads <= 1)
+    {
+        for (int i=0; i<num_hosts; ++i)
+            mooon_download(tasks[i]);
+    }
+    else
+    {
+        std::vector<CDownloadThread*> download_threads(num_threads);
+        std::vector<mooon::sys::CThreadEngine*> thread_engines(num_threads);
+        for (int i=0; i<num_threads; ++i)
+            download_threads[i] = new CDownloadThread(i);
+        for (int i=0; i<num_hosts; ++i)
+            download_threads[i % num_threads]->add_task(tasks[i]);
+
+        for (int i=0; i<num_threads; ++i)
         {
-            if (color)
-                fprintf(stdout, PRINT_COLOR_NONE); // color = true;
-            fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", host.c_str(), strerror(errno), local_filepath.c_str());
+            CDownloadThread* download_thread = download_threads[i];
+            thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&CDownloadThread::run, download_thread));
         }
-        else
+        for (int i=0; i<num_threads; ++i)
         {
-            mooon::sys::CStopWatch stop_watch;
-
-            try
-            {
-                int64_t file_size = 0;
-                mooon::net::CLibssh2 libssh2(host, port, user, password, mooon::argument::t->value());
-                libssh2.download(source_files[j], local_fs, &file_size);
-
-                fprintf(stdout, "[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS: %" PRId64" bytes (%s)\n", host.c_str(), file_size, source_files[j].c_str());
-                results[j].success = true;
-            }
-            catch (mooon::sys::CSyscallException& ex)
-            {
-                if (color)
-                    fprintf(stdout, PRINT_COLOR_NONE); // color = true;
-
-                fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", host.c_str(), ex.str().c_str(), source_files[j].c_str());
-            }
-            catch (mooon::utils::CException& ex)
-            {
-                if (color)
-                    fprintf(stdout, PRINT_COLOR_NONE); // color = true;
-
-                fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", host.c_str(), ex.str().c_str(), source_files[j].c_str());
-            }
-
-            results[j].seconds = stop_watch.get_elapsed_microseconds() / 1000000;
+            thread_engines[i]->join();
+            delete download_threads[i];
+            delete thread_engines[i];
         }
     }
     mooon::net::CLibssh2::fini();
+    const uint64_t milliseconds = stop_watch.get_elapsed_microseconds() / 1000;
 
     // 输出总结
     std::cout << std::endl;
     std::cout << "================================" << std::endl;
     int num_success = 0; // 成功的个数
-    int num_failure = 0; // 失败的个数
+    int64_t num_bytes = 0; // 所有主机下载的总字节数
     for (std::vector<struct ResultInfo>::size_type i=0; i<results.size(); ++i)
     {
         const struct ResultInfo& result_info = results[i];
         std::cout << result_info << std::endl;
 
+        num_bytes += result_info.num_bytes;
         if (result_info.success)
             ++num_success;
         else
             ++num_failure;
     }
     std::cout << "SUCCESS: " << num_success << ", FAILURE: " << num_failure << std::endl;
+    std::cout << "BYTES: " << num_bytes << ", MILLISECONDS: " << milliseconds
+              << mooon::utils::CStringUtils::format_string(", THROUGHPUT: %.2f MB/s", get_throughput(num_bytes, milliseconds)) << std::endl;
 #else
     fprintf(stderr, "NOT IMPLEMENT! please install libssh2 (https://www.libssh2.org/) into /usr/local/libssh2 and recompile.\n");
 #endif // MOOON_HAVE_LIBSSH2 == 1
@@ -300,3 +386,162 @@ void escape_args(int argc, char* argv[])
 
     // 清了作history命令看到的结果
 }
+
+int get_num_of_threads(int num_hosts)
+{
+    int num_threads = mooon::argument::thr->value();
+
+    const char* str = getenv("THR");
+    if (str != NULL)
+    {
+        if (!mooon::utils::CStringUtils::string2int(str, num_threads))
+            num_threads = mooon::argument::thr->value();
+    }
+
+    if ((num_threads > num_hosts) || (0 == num_threads))
+        num_threads = num_hosts;
+    return num_threads;
+}
+
+void CDownloadThread::run()
+{
+    for (std::vector<struct DownloadTask>::size_type i=0; i<_tasks.size(); ++i)
+        mooon_download(_tasks[i]);
+}
+
+void report_progress(const struct mooon::net::CLibssh2::SftpTransfer& transfer, bool finished, void* context)
+{
+    struct ProgressContext* progress_context = static_cast<struct ProgressContext*>(context);
+    const uint64_t interval = static_cast<uint64_t>(mooon::argument::progress->value()) * 1000000000;
+    const uint64_t now = mooon::sys::CClock::get_nanoseconds();
+
+    // 结束的文件在下载完后统一输出
+    if (finished || (0 == interval))
+        return;
+
+    uint64_t& report_nanoseconds = progress_context->report_nanoseconds[&transfer];
+    if (0 == report_nanoseconds)
+        report_nanoseconds = progress_context->start_nanoseconds;
+    if (now - report_nanoseconds < interval)
+        return;
+
+    report_nanoseconds = now;
+    const int64_t num_bytes = transfer.offset + transfer.num_bytes;
+    const double percent = (transfer.file_size > 0)? (100.0 * num_bytes / transfer.file_size): 0.0;
+    fprintf(stdout, "[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] %" PRId64"/%" PRId64" bytes (%.1f%%), %.2f MB/s (%s)\n",
+            progress_context->ip->c_str(), num_bytes, transfer.file_size, percent,
+            get_throughput(transfer.num_bytes, (now - progress_context->start_nanoseconds) / 1000000), transfer.remote_filepath.c_str());
+}
+
+void mooon_download(const struct DownloadTask& task)
+{
+    const std::vector<std::string>& source_files = *task.source_files;
+    const int num_source_files = static_cast<int>(source_files.size());
+
+    if (task.create_directory)
+    {
+        try
+        {
+            mooon::sys::CDirUtils::create_directory_recursive(task.directory.c_str());
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s\n", task.ip.c_str(), ex.str().c_str());
+            return;
+        }
+    }
+
+    if (mooon::argument::sftp->is_true())
+    {
+        std::vector<struct mooon::net::CLibssh2::SftpTransfer> transfers;
+        for (int j=0; j<num_source_files; ++j)
+        {
+            transfers.push_back(mooon::net::CLibssh2::SftpTransfer(
+                    source_files[j], task.directory + std::string("/") + mooon::utils::CStringUtils::extract_filename(source_files[j]),
+                    mooon::argument::resume->is_true()));
+        }
+
+        mooon::sys::CStopWatch stop_watch;
+        try
+        {
+            struct ProgressContext progress_context;
+            progress_context.ip = &task.ip;
+            progress_context.start_nanoseconds = mooon::sys::CClock::get_nanoseconds();
+
+            mooon::net::CLibssh2 libssh2(task.ip, task.port, task.user, task.password, mooon::argument::t->value());
+            libssh2.sftp_download(&transfers, mooon::argument::parallel->value(), mooon::argument::buffer_size->value(), report_progress, &progress_context);
+
+            for (int j=0; j<num_source_files; ++j)
+            {
+                const struct mooon::net::CLibssh2::SftpTransfer& transfer = transfers[j];
+                task.results[j].num_bytes = transfer.num_bytes;
+                task.results[j].milliseconds = transfer.milliseconds;
+
+                if (transfer.errmsg.empty())
+                {
+                    fprintf(stdout, "[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS: %" PRId64" bytes (resumed from %" PRId64"), %.2f MB/s (%s)\n",
+                            task.ip.c_str(), transfer.num_bytes, transfer.offset, get_throughput(transfer.num_bytes, transfer.milliseconds), source_files[j].c_str());
+                    task.results[j].success = true;
+                }
+                else
+                {
+                    fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", task.ip.c_str(), transfer.errmsg.c_str(), source_files[j].c_str());
+                }
+            }
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s\n", task.ip.c_str(), ex.str().c_str());
+        }
+        catch (mooon::utils::CException& ex)
+        {
+            fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s\n", task.ip.c_str(), ex.str().c_str());
+        }
+
+        // 会话出错时未结束的文件没有耗时，记为总耗时
+        const uint32_t milliseconds = stop_watch.get_elapsed_microseconds() / 1000;
+        for (int j=0; j<num_source_files; ++j)
+        {
+            if (!task.results[j].success)
+                task.results[j].milliseconds = milliseconds;
+        }
+    }
+    else
+    {
+        // SCP不支持从指定位置开始，总是完整下载
+        for (int j=0; j<num_source_files; ++j)
+        {
+            std::string local_filepath = task.directory + std::string("/") + mooon::utils::CStringUtils::extract_filename(source_files[j]);
+            std::ofstream local_fs(local_filepath.c_str(), std::ios_base::out|std::ios::binary|std::ios::trunc);
+            if (!local_fs)
+            {
+                fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", task.ip.c_str(), strerror(errno), local_filepath.c_str());
+                continue;
+            }
+
+            mooon::sys::CStopWatch stop_watch;
+            try
+            {
+                int64_t file_size = 0;
+                mooon::net::CLibssh2 libssh2(task.ip, task.port, task.user, task.password, mooon::argument::t->value());
+                libssh2.download(source_files[j], local_fs, &file_size);
+
+                task.results[j].milliseconds = stop_watch.get_elapsed_microseconds() / 1000;
+                task.results[j].num_bytes = file_size;
+                task.results[j].success = true;
+                fprintf(stdout, "[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS: %" PRId64" bytes, %.2f MB/s (%s)\n",
+                        task.ip.c_str(), file_size, get_throughput(file_size, task.results[j].milliseconds), source_files[j].c_str());
+            }
+            catch (mooon::sys::CSyscallException& ex)
+            {
+                task.results[j].milliseconds = stop_watch.get_elapsed_microseconds() / 1000;
+                fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", task.ip.c_str(), ex.str().c_str(), source_files[j].c_str());
+            }
+            catch (mooon::utils::CException& ex)
+            {
+                task.results[j].milliseconds = stop_watch.get_elapsed_microseconds() / 1000;
+                fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", task.ip.c_str(), ex.str().c_str(), source_files[j].c_str());
+            }
+        }
+    }
+}
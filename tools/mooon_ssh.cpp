@@ -26,10 +26,21 @@
 //
 // 可通过为参数“-thr”指定大于1的值并发执行
 //
+// 主机数很多时，可为参数“-sessions”指定大于0的值，改用事件驱动的执行引擎，
+// 由“-thr”个线程以非阻塞方式同时驱动最多“-sessions”个会话，
+// 每台主机结束时即输出其结果，“-cps”限制每秒新建的连接数，“-timeout”限制每台主机的执行时长：
+// mooon_ssh -u=root -p=test -h="$HOSTS" -thr=4 -sessions=2000 -cps=500 -timeout=60 -c='uptime'
+//
 // 可环境变量HOSTS替代参数“-h”
 // 可环境变量USER替代参数“-u”
 // 可环境变量PASSWORD替代参数“-p”
+//
+// 反复对同一批主机执行命令时，可先启动常驻的控制进程缓存已认证的会话，
+// 之后的mooon_ssh通过参数“-ctl”经它执行，省去每次的TCP连接、握手和认证：
+// mooon_ssh -daemon=1 -ctl=/tmp/mooon_ssh.sock -thr=32 &
+// mooon_ssh -ctl=/tmp/mooon_ssh.sock -u=root -p=test -h="127.0.0.1,192.168.0.1" -c='ls /tmp'
 #include "mooon/net/libssh2.h" // 提供远程执行命令接口
+#include "mooon/net/ssh_engine.h"
 #include "mooon/sys/error.h"
 #include "mooon/sys/stop_watch.h"
 #include "mooon/sys/thread_engine.h"
@@ -37,8 +48,11 @@
 #include "mooon/utils/print_color.h"
 #include "mooon/utils/string_utils.h"
 #include "mooon/utils/tokener.h"
+#include <arpa/inet.h>
 #include <iostream>
 #include <sstream>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 // 逗号分隔的远程主机IP列表
 STRING_ARG_DEFINE(h, "", "Connect to the remote machines on the given hosts separated by comma, can be replaced by environment variable 'H', example: -h='192.168.1.10,192.168.1.11'");
@@ -63,6 +77,20 @@ INTEGER_ARG_DEFINE(uint8_t, v, 1, 0, 2, "Verbosity, how much troubleshooting inf
 // 线程数（parallel），多线程并行执行
 INTEGER_ARG_DEFINE(int, thr, 1, 0, 2018, "The number of threads to parallel execute (0: number of hosts), can be replaced by environment variable 'THR'");
 
+// 控制进程监听的Unix套接字路径，指定后经控制进程执行命令
+STRING_ARG_DEFINE(ctl, "", "The unix socket path of the control daemon, commands are executed through the sessions cached by it, example: -ctl=/tmp/mooon_ssh.sock");
+// 为1表示作为控制进程运行，此时“-thr”为同时处理的请求数
+INTEGER_ARG_DEFINE(uint8_t, daemon, 0, 0, 1, "Run as the control daemon listening on the unix socket given by '-ctl'");
+// 控制进程中会话的最长空闲时长，单位为秒
+INTEGER_ARG_DEFINE(uint32_t, idle, 600, 1, 86400, "The number of seconds an idle session is cached by the control daemon");
+
+// 大于0时使用事件驱动的执行引擎，为同时进行的会话数上限，此时“-thr”为引擎的线程数
+INTEGER_ARG_DEFINE(uint32_t, sessions, 0, 0, 1000000, "Use the event-driven engine with at most this number of concurrent sessions driven by '-thr' threads (0: one blocking session at a time per thread)");
+// 事件驱动的执行引擎每秒新建的连接数上限
+INTEGER_ARG_DEFINE(uint32_t, cps, 0, 0, 1000000, "The max number of new connections per second of the event-driven engine (0: unlimited)");
+// 事件驱动的执行引擎中每台主机的最长执行时长，单位为秒
+INTEGER_ARG_DEFINE(uint32_t, timeout, 0, 0, 864000, "The max number of seconds a host may take in the event-driven engine, from connecting to the end of the command (0: unlimited)");
+
 // 结果信息
 struct ResultInfo
 {
@@ -101,6 +129,15 @@ static void mooon_ssh(bool thread, struct ResultInfo& result, const std::string&
 // 隐藏密码
 static void hide_password(int argc, char* argv[]);
 
+// 以事件驱动的执行引擎在所有主机上执行
+static void mooon_ssh_engine(std::vector<struct ResultInfo>& results, const std::vector<std::string>& hosts_ip, int port, const std::string& user, const std::string& password, const std::string& commands);
+
+// 作为控制进程运行，不返回
+static void run_control_daemon(const std::string& ctl_path);
+
+// 经控制进程执行命令
+static void execute_by_daemon(const std::string& ctl_path, const std::string& remote_host_ip, int port, const std::string& user, const std::string& password, const std::string& commands, std::ostream& out, int* exitcode, std::string* exitsignal, std::string* errmsg, int64_t* num_bytes);
+
 struct SshTask
 {
     struct ResultInfo* result;
@@ -162,6 +199,18 @@ int main(int argc, char* argv[])
     mooon::utils::CStringUtils::trim(password);
     hide_password(argc, argv);
 
+    if (mooon::argument::daemon->value() != 0)
+    {
+        if (mooon::argument::ctl->value().empty())
+        {
+            fprintf(stderr, "parameter[-ctl]'s value not set\n\n");
+            fprintf(stderr, "%s\n", mooon::utils::CArgumentContainer::get_singleton()->usage_string().c_str());
+            exit(1);
+        }
+
+        run_control_daemon(mooon::argument::ctl->value());
+    }
+
     // 检查参数（-P）
     const char* port_ = getenv("PORT");
     if (port_ != NULL)
@@ -254,57 +303,66 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
-    // 先创建线程对象，但不要启动线程
-    const int num_threads = get_num_of_threads((int)hosts_ip.size());
-    std::vector<CSShThread*> ssh_threads;
-    if (num_threads > 1)
+    std::vector<struct ResultInfo> results(num_remote_hosts_ip);
+    if (mooon::argument::sessions->value() > 0)
     {
-        for (int i=0; i<num_threads; ++i)
-        {
-            CSShThread* ssh_thread = new CSShThread(i);
-            ssh_threads.push_back(ssh_thread);
-        }
+        mooon::net::CLibssh2::init();
+        mooon_ssh_engine(results, hosts_ip, port, user, password, commands);
+        mooon::net::CLibssh2::fini();
     }
-
-    mooon::net::CLibssh2::init();
-    std::vector<struct ResultInfo> results(num_remote_hosts_ip);
-    for (int i=0; i<num_remote_hosts_ip; ++i)
+    else
     {
-        struct ResultInfo& result = results[i];
-        const std::string& remote_host_ip = hosts_ip[i];
-
-        if (num_threads <= 1)
-        {
-            mooon_ssh(false, result, remote_host_ip, port, user, password, commands);
-        }
-        else
+        // 先创建线程对象，但不要启动线程
+        const int num_threads = get_num_of_threads((int)hosts_ip.size());
+        std::vector<CSShThread*> ssh_threads;
+        if (num_threads > 1)
         {
-            CSShThread* ssh_thread = ssh_threads[i % num_threads];
-            ssh_thread->add_task(result, remote_host_ip, port, user, password, commands);
+            for (int i=0; i<num_threads; ++i)
+            {
+                CSShThread* ssh_thread = new CSShThread(i);
+                ssh_threads.push_back(ssh_thread);
+            }
         }
-    } // for
 
-    // 启动所有线程
-    if (num_threads > 1)
-    {
-        std::vector<mooon::sys::CThreadEngine*> thread_engines(num_threads);
-        for (int i=0; i<num_threads; ++i)
+        mooon::net::CLibssh2::init();
+        for (int i=0; i<num_remote_hosts_ip; ++i)
         {
-            CSShThread* ssh_thread = ssh_threads[i];
-            thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&CSShThread::run, ssh_thread));
-        }
+            struct ResultInfo& result = results[i];
+            const std::string& remote_host_ip = hosts_ip[i];
+
+            if (num_threads <= 1)
+            {
+                mooon_ssh(false, result, remote_host_ip, port, user, password, commands);
+            }
+            else
+            {
+                CSShThread* ssh_thread = ssh_threads[i % num_threads];
+                ssh_thread->add_task(result, remote_host_ip, port, user, password, commands);
+            }
+        } // for
 
-        for (int i=0; i<num_threads; ++i)
+        // 启动所有线程
+        if (num_threads > 1)
         {
-            thread_engines[i]->join();
-            delete ssh_threads[i];
-            delete thread_engines[i];
-        }
+            std::vector<mooon::sys::CThreadEngine*> thread_engines(num_threads);
+            for (int i=0; i<num_threads; ++i)
+            {
+                CSShThread* ssh_thread = ssh_threads[i];
+                thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&CSShThread::run, ssh_thread));
+            }
+
+            for (int i=0; i<num_threads; ++i)
+            {
+                thread_engines[i]->join();
+                delete ssh_threads[i];
+                delete thread_engines[i];
+            }
 
-        thread_engines.clear();
-        ssh_threads.clear();
+            thread_engines.clear();
+            ssh_threads.clear();
+        }
+        mooon::net::CLibssh2::fini();
     }
-    mooon::net::CLibssh2::fini();
 
     std::cout << std::endl;
     if ((mooon::argument::v->value() >= 1) && (mooon::argument::v->value() <= 1))
@@ -401,9 +459,15 @@ void mooon_ssh(bool thread, struct ResultInfo& result, const std::string& remote
     try
     {
         std::stringstream out;
-        mooon::net::CLibssh2 libssh2(remote_host_ip, port, user, password, mooon::argument::t->value());
-
-        libssh2.remotely_execute(commands, out, &exitcode, &exitsignal, &errmsg, &num_bytes);
+        if (mooon::argument::ctl->value().empty())
+        {
+            mooon::net::CLibssh2 libssh2(remote_host_ip, port, user, password, mooon::argument::t->value());
+            libssh2.remotely_execute(commands, out, &exitcode, &exitsignal, &errmsg, &num_bytes);
+        }
+        else
+        {
+            execute_by_daemon(mooon::argument::ctl->value(), remote_host_ip, port, user, password, commands, out, &exitcode, &exitsignal, &errmsg, &num_bytes);
+        }
         str = PRINT_COLOR_NONE;
         screen += str;
         if (!thread)
@@ -572,3 +636,284 @@ void CSShThread::add_task(struct ResultInfo& result, const std::string& remote_h
     task.commands = commands;
     _tasks.push_back(task);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// 控制进程和mooon_ssh间的消息由若干字段组成，每个字段为4字节网络字节序的长度加内容
+// 请求：ip、port、user、password、commands
+// 响应：exitcode、exitsignal、errmsg、output、exception（执行失败时的出错信息，成功时为空）
+
+static bool full_write(int fd, const char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t bytes = write(fd, buffer, size);
+        if (bytes > 0)
+        {
+            buffer += bytes;
+            size -= bytes;
+        }
+        else if ((bytes != -1) || (errno != EINTR))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool full_read(int fd, char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t bytes = read(fd, buffer, size);
+        if (bytes > 0)
+        {
+            buffer += bytes;
+            size -= bytes;
+        }
+        else if ((bytes != -1) || (errno != EINTR))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool write_field(int fd, const std::string& field)
+{
+    const uint32_t length = htonl(static_cast<uint32_t>(field.size()));
+    return full_write(fd, reinterpret_cast<const char*>(&length), sizeof(length))
+        && full_write(fd, field.data(), field.size());
+}
+
+static bool read_field(int fd, std::string* field)
+{
+    uint32_t length;
+    if (!full_read(fd, reinterpret_cast<char*>(&length), sizeof(length)))
+        return false;
+
+    field->resize(ntohl(length));
+    return field->empty() || full_read(fd, &(*field)[0], field->size());
+}
+
+static void handle_control_request(int fd, mooon::net::CLibssh2Pool* libssh2_pool)
+{
+    std::string remote_host_ip, port_str, user, password, commands;
+    if (!read_field(fd, &remote_host_ip) || !read_field(fd, &port_str) || !read_field(fd, &user)
+     || !read_field(fd, &password) || !read_field(fd, &commands))
+        return;
+
+    int port = 0;
+    int exitcode = 0;
+    int64_t num_bytes = 0;
+    std::string exitsignal, errmsg, exception;
+    std::stringstream out;
+    (void)mooon::utils::CStringUtils::string2int(port_str.c_str(), port);
+
+    // 复用的会话可能已被服务端断开，出错时用新建的会话重试一次
+    for (int i=0; i<2; ++i)
+    {
+        bool reused = false;
+        mooon::net::CLibssh2* libssh2 = NULL;
+
+        try
+        {
+            libssh2 = libssh2_pool->get(remote_host_ip, static_cast<uint16_t>(port), user, password, &reused);
+            libssh2->remotely_execute(commands, out, &exitcode, &exitsignal, &errmsg, &num_bytes);
+            libssh2_pool->put(libssh2);
+            exception.clear();
+            break;
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            exception = ex.str();
+        }
+        catch (mooon::utils::CException& ex)
+        {
+            exception = ex.str();
+        }
+
+        if (libssh2 != NULL)
+            libssh2_pool->put(libssh2, true);
+        if (!reused)
+            break;
+        out.str("");
+    }
+
+    (void)(write_field(fd, mooon::utils::CStringUtils::int_tostring(exitcode))
+        && write_field(fd, exitsignal)
+        && write_field(fd, errmsg)
+        && write_field(fd, out.str())
+        && write_field(fd, exception));
+}
+
+static void control_worker(int listen_fd, mooon::net::CLibssh2Pool* libssh2_pool)
+{
+    for (;;)
+    {
+        const int fd = accept(listen_fd, NULL, NULL);
+        if (-1 == fd)
+        {
+            if (EINTR == errno)
+                continue;
+            fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            mooon::sys::CUtils::millisleep(100);
+            continue;
+        }
+
+        handle_control_request(fd, libssh2_pool);
+        close(fd);
+    }
+}
+
+void run_control_daemon(const std::string& ctl_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (ctl_path.size() >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "parameter[-ctl]'s value too long\n");
+        exit(1);
+    }
+    strncpy(addr.sun_path, ctl_path.c_str(), sizeof(addr.sun_path)-1);
+
+    // 只允许本用户连接，控制进程持有已认证的会话
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    const mode_t old_mask = umask(077);
+    (void)unlink(ctl_path.c_str());
+    if ((-1 == listen_fd)
+     || (-1 == bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+     || (-1 == listen(listen_fd, 1024)))
+    {
+        fprintf(stderr, "listen on %s failed: %s\n", ctl_path.c_str(), strerror(errno));
+        exit(1);
+    }
+    (void)umask(old_mask);
+
+    int num_threads = mooon::argument::thr->value();
+    if (num_threads < 1)
+        num_threads = 1;
+    mooon::net::CLibssh2::init();
+    mooon::net::CLibssh2Pool libssh2_pool(mooon::argument::idle->value(), mooon::argument::t->value());
+    std::vector<mooon::sys::CThreadEngine*> thread_engines(num_threads);
+    for (int i=0; i<num_threads; ++i)
+        thread_engines[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&control_worker, listen_fd, &libssh2_pool));
+
+    fprintf(stdout, "control daemon listening on %s with %d threads\n", ctl_path.c_str(), num_threads);
+    for (;;)
+    {
+        mooon::sys::CUtils::millisleep(10000);
+        libssh2_pool.clear_idle();
+    }
+}
+
+void execute_by_daemon(const std::string& ctl_path, const std::string& remote_host_ip, int port, const std::string& user, const std::string& password, const std::string& commands, std::ostream& out, int* exitcode, std::string* exitsignal, std::string* errmsg, int64_t* num_bytes)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, ctl_path.c_str(), sizeof(addr.sun_path)-1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(strerror(errno), errno, "socket");
+    if (-1 == connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+    {
+        const int errcode = errno;
+        close(fd);
+        THROW_SYSCALL_EXCEPTION(mooon::utils::CStringUtils::format_string("connect %s failed: %s", ctl_path.c_str(), strerror(errcode)), errcode, "connect");
+    }
+
+    std::string exitcode_str, output, exception;
+    const bool ok = write_field(fd, remote_host_ip)
+                 && write_field(fd, mooon::utils::CStringUtils::int_tostring(port))
+                 && write_field(fd, user)
+                 && write_field(fd, password)
+                 && write_field(fd, commands)
+                 && read_field(fd, &exitcode_str)
+                 && read_field(fd, exitsignal)
+                 && read_field(fd, errmsg)
+                 && read_field(fd, &output)
+                 && read_field(fd, &exception);
+    close(fd);
+
+    if (!ok)
+        THROW_EXCEPTION("control daemon closed the connection", -1);
+    if (!exception.empty())
+        THROW_EXCEPTION(exception, -1);
+    (void)mooon::utils::CStringUtils::string2int(exitcode_str.c_str(), *exitcode);
+    *num_bytes = static_cast<int64_t>(output.size());
+    out << output;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 每台主机结束时即输出其结果，整段一次输出，多个引擎线程的输出不会交错
+class CSshObserver: public mooon::net::ISshObserver
+{
+public:
+    CSshObserver(std::vector<struct ResultInfo>* results)
+        : _results(results)
+    {
+    }
+
+private:
+    virtual void on_finished(const struct mooon::net::SshResult& ssh_result)
+    {
+        struct ResultInfo& result = (*_results)[ssh_result.index];
+        std::string screen;
+
+        result.ip = ssh_result.ip;
+        result.success = ssh_result.success();
+        result.seconds = ssh_result.milliseconds / 1000;
+        if ((mooon::argument::v->value() >= 1) && (mooon::argument::v->value() <= 1))
+        {
+            screen = mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"]\n", ssh_result.ip.c_str());
+            screen += ssh_result.output;
+            if (result.success)
+                screen += mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS (%u seconds)\n\n", ssh_result.ip.c_str(), result.seconds);
+            else if (!ssh_result.errmsg.empty())
+                screen += mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s\n\n", ssh_result.ip.c_str(), ssh_result.errmsg.c_str());
+            else if (!ssh_result.exitsignal.empty())
+                screen += mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] %s\n\n", ssh_result.ip.c_str(), ssh_result.exitsignal.c_str());
+            else
+                screen += mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] command return %d\n\n", ssh_result.ip.c_str(), ssh_result.exitcode);
+        }
+
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+        fwrite(screen.data(), 1, screen.size(), result.success? stdout: stderr);
+    }
+
+private:
+    mooon::sys::CLock _lock;
+    std::vector<struct ResultInfo>* _results;
+};
+
+void mooon_ssh_engine(std::vector<struct ResultInfo>& results, const std::vector<std::string>& hosts_ip, int port, const std::string& user, const std::string& password, const std::string& commands)
+{
+    CSshObserver observer(&results);
+    mooon::net::CSshEngine engine(&observer, get_num_of_threads(static_cast<int>(hosts_ip.size())));
+
+    engine.set_timeout_seconds(mooon::argument::timeout->value());
+    engine.set_max_sessions(mooon::argument::sessions->value());
+    engine.set_max_connects_per_second(mooon::argument::cps->value());
+    for (std::vector<std::string>::size_type i=0; i<hosts_ip.size(); ++i)
+    {
+        results[i].ip = hosts_ip[i];
+        (void)engine.add_host(hosts_ip[i], static_cast<uint16_t>(port));
+    }
+
+    try
+    {
+        engine.execute(user, password, commands);
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "engine failed: %s\n", ex.str().c_str());
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "engine failed: %s\n", ex.str().c_str());
+    }
+}
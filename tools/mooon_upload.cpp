@@ -25,6 +25,16 @@
 // ./mooon_upload -h=192.168.10.11,192.168.10.12 -p=6000 -u=root -P='root123' -s=./abc -d=/tmp/
 // 表示将本地的文件./abc上传到两台机器192.168.10.11和192.168.10.12的/tmp/目录
 //
+// 每个本地文件只读一次（映射到内存），由所有主机共享，
+// 指定“-z=1”时先在本地压缩一次，远端以“gzip -dc”（或“-zc”指定的zstd、lz4）解压，要求远端有对应的命令；
+// 指定“-relay=1”时以接力方式分发：已收到文件的主机再转发给尚未收到的主机，
+// 每轮持有文件的主机数翻倍，本机只需发出少量副本，要求远端有bash和nc，
+// 转发使用“-rport”指定的TCP端口，转发失败的主机改由本机直接上传
+//
+// 指定“-skip=1”时跳过远端大小和修改时间都相同的文件，“-skip=2”时跳过远端MD5相同的文件（远端执行md5sum）；
+// 指定“-delta=1”时只发送与远端文件不同的块（按“-bs”对齐分块，以MD5比较，要求远端有支持--filter的split），
+// 远端校验合成后的文件的MD5后才替换，“-skip”和“-delta”对接力方式无效
+//
 // 可环境变量HOSTS替代参数“-h”
 // 可环境变量USER替代参数“-u”
 // 可环境变量PASSWORD替代参数“-p”
@@ -61,9 +71,12 @@
 // /usr/lib64/libc.a
 // /usr/lib/x86_64-redhat-linux6E/lib64/libc.a
 #include "mooon/net/libssh2.h"
+#include "mooon/sys/mmap.h"
 #include "mooon/sys/stop_watch.h"
 #include "mooon/sys/thread_engine.h"
 #include "mooon/utils/args_parser.h"
+#include "mooon/utils/compressor.h"
+#include "mooon/utils/md5_helper.h"
 #include "mooon/utils/print_color.h"
 #include "mooon/utils/string_utils.h"
 #include "mooon/utils/tokener.h"
@@ -89,6 +102,24 @@ STRING_ARG_DEFINE(d, "", "The remote destination directory, example: -d='/tmp/'"
 // 线程数（parallel），多线程并行执行
 INTEGER_ARG_DEFINE(int, thr, 1, 0, 2018, "The number of threads to parallel upload (0: number of hosts), can be replaced by environment variable 'THR'");
 
+// 是否压缩后上传
+INTEGER_ARG_DEFINE(uint8_t, z, 0, 0, 1, "Compress each source file once before uploading, decompressed by 'gzip -dc' (or the command of '-zc') on the remote machines");
+// 压缩方式
+STRING_ARG_DEFINE(zc, "gzip", "The compression used by '-z=1': gzip, zstd or lz4, zstd is faster and smaller than gzip if libmooon was built with it");
+// 是否接力分发
+INTEGER_ARG_DEFINE(uint8_t, relay, 0, 0, 1, "Relay mode, the remote machines which have received a file forward it to the others by bash and nc, '-thr' copies are sent by this machine in each round");
+// 接力分发使用的端口
+INTEGER_ARG_DEFINE(uint16_t, rport, 38219, 1024, 65535, "The TCP port listened by nc on the remote machines in relay mode");
+// 是否跳过未变化的文件
+INTEGER_ARG_DEFINE(uint8_t, skip, 0, 0, 2, "Skip the files unchanged on the remote machines, 1: same size and mtime, 2: same md5 computed by md5sum remotely");
+// 是否只发送变化的块
+INTEGER_ARG_DEFINE(uint8_t, delta, 0, 0, 1, "Send only the blocks differing from the remote file, compared by md5 of '-bs' aligned blocks");
+// 增量上传的块大小
+INTEGER_ARG_DEFINE(uint32_t, bs, 1048576, 4096, 67108864, "The block size in bytes of '-delta=1'");
+
+// 压缩方式，由“-zc”指定，启动时检查
+static mooon::utils::compression_t sg_compression = mooon::utils::compression_gzip;
+
 // 结果信息
 struct ResultInfo
 {
@@ -128,6 +159,17 @@ static void mooon_upload(bool thread, const struct UploadTask& task);
 // 隐藏密码
 static void hide_password(int argc, char* argv[]);
 
+// 只读一次的本地文件
+struct SourceFile
+{
+    std::string filepath;
+    mooon::sys::mmap_t* mmap;
+    struct stat fileinfo;
+    std::string compressed; // 指定了“-z”时为压缩后的数据
+    std::string md5; // 指定了“-skip=2”或“-delta=1”时为整个文件的MD5
+    std::vector<std::string> block_md5s; // 指定了“-delta=1”时为按“-bs”分块的各块的MD5
+};
+
 struct UploadTask
 {
     struct ResultInfo* result;
@@ -137,8 +179,23 @@ struct UploadTask
     std::string password;
     std::string source_filepath;
     std::string remote_filepath;
+    const struct SourceFile* source;
+    mooon::net::CLibssh2Pool* libssh2_pool; // 同一主机的多个文件复用一个会话
 };
 
+// 读入并按需压缩所有的本地文件
+static bool load_source_files(const std::vector<std::string>& source_files, std::vector<struct SourceFile>* sources);
+static void unload_source_files(std::vector<struct SourceFile>* sources);
+
+// 通过已建好的会话上传一个文件
+static void upload_to_host(mooon::net::CLibssh2* libssh2, const struct SourceFile& source, const std::string& remote_filepath);
+
+// 按“-skip”和“-delta”跳过未变化的文件或只发送变化的块，否则完整上传，返回上传方式的说明
+static std::string sync_to_host(mooon::net::CLibssh2* libssh2, const struct SourceFile& source, const std::string& remote_filepath);
+
+// 接力分发
+static void mooon_upload_relay(std::vector<struct ResultInfo>& results, const std::vector<std::string>& hosts_ip, int port, const std::string& user, const std::string& password, const std::vector<struct SourceFile>& sources, const std::string& directory, int num_threads, mooon::net::CLibssh2Pool* libssh2_pool);
+
 class CUploadThread
 {
 public:
@@ -213,6 +270,22 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    // 检查参数（-zc），只能是远端有命令可以解压的
+    try
+    {
+        sg_compression = mooon::utils::get_compression_by_name(mooon::argument::zc->value());
+        if ((sg_compression != mooon::utils::compression_gzip) && (sg_compression != mooon::utils::compression_zstd) && (sg_compression != mooon::utils::compression_lz4))
+            THROW_EXCEPTION("only gzip, zstd and lz4 supported", EINVAL);
+        if (!mooon::utils::is_compression_supported(sg_compression))
+            THROW_EXCEPTION("libmooon built without it", ENOTSUP);
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "parameter[-zc]'s value invalid: %s\n\n", ex.str().c_str());
+        fprintf(stderr, "%s\n", mooon::utils::CArgumentContainer::get_singleton()->usage_string().c_str());
+        exit(1);
+    }
+
     // 检查参数（-h）
     if (hosts.empty())
     {
@@ -281,6 +354,9 @@ int main(int argc, char* argv[])
     time_t start_seconds = time(NULL);
     std::vector<std::string> source_files;
     int num_source_files = mooon::utils::CTokener::split(&source_files, sources, ",", true);
+    std::vector<struct SourceFile> loaded_sources;
+    if (!load_source_files(source_files, &loaded_sources))
+        exit(1);
 
     std::vector<std::string> hosts_ip;
     const std::string& remote_hosts_ip = hosts;
@@ -295,7 +371,7 @@ int main(int argc, char* argv[])
     // 先创建线程对象，但不要启动线程
     const int num_threads = get_num_of_threads((int)hosts_ip.size());
     std::vector<CUploadThread*> upload_threads;
-    if (num_threads > 1)
+    if ((num_threads > 1) && (0 == mooon::argument::relay->value()))
     {
         for (int i=0; i<num_threads; ++i)
         {
@@ -305,8 +381,11 @@ int main(int argc, char* argv[])
     }
 
     mooon::net::CLibssh2::init();
+    mooon::net::CLibssh2Pool* libssh2_pool = new mooon::net::CLibssh2Pool(3600, mooon::argument::t->value());
     std::vector<struct ResultInfo> results(num_remote_hosts_ip * num_source_files);
-    for (int i=0, k=0; i<num_remote_hosts_ip; ++i)
+    if (mooon::argument::relay->value() != 0)
+        mooon_upload_relay(results, hosts_ip, port, user, password, loaded_sources, directory, num_threads, libssh2_pool);
+    for (int i=0, k=0; (0 == mooon::argument::relay->value()) && (i<num_remote_hosts_ip); ++i)
     {
     	for (int j=0; j<num_source_files; ++j)
     	{
@@ -320,6 +399,8 @@ int main(int argc, char* argv[])
     	    task.password = password;
     	    task.source_filepath = source_files[j];
     	    task.remote_filepath = remote_filepath;
+    	    task.source = &loaded_sources[j];
+    	    task.libssh2_pool = libssh2_pool;
 
 			if (num_threads <= 1)
 			{
@@ -334,7 +415,7 @@ int main(int argc, char* argv[])
     }
 
     // 启动所有线程
-    if (num_threads > 1)
+    if (!upload_threads.empty())
     {
         std::vector<mooon::sys::CThreadEngine*> thread_engines(num_threads);
         for (int i=0; i<num_threads; ++i)
@@ -353,7 +434,9 @@ int main(int argc, char* argv[])
         thread_engines.clear();
         upload_threads.clear();
     }
+    delete libssh2_pool;
     mooon::net::CLibssh2::fini();
+    unload_source_files(&loaded_sources);
 
     // 输出总结
     std::cout << std::endl;
@@ -435,14 +518,18 @@ void mooon_upload(bool thread, const struct UploadTask& task)
         fprintf(stdout, "%s", str.c_str());
 
     mooon::sys::CStopWatch stop_watch;
+    mooon::net::CLibssh2* libssh2 = NULL;
     try
     {
         int64_t file_size = 0;
-        mooon::net::CLibssh2 libssh2(task.remote_host_ip, task.port, task.user, task.password, mooon::argument::t->value());
-        libssh2.upload(task.source_filepath, task.remote_filepath, &file_size);
+        libssh2 = task.libssh2_pool->get(task.remote_host_ip, task.port, task.user, task.password);
+        file_size = task.source->fileinfo.st_size;
+        const std::string mode = sync_to_host(libssh2, *task.source, task.remote_filepath);
+        task.libssh2_pool->put(libssh2);
+        libssh2 = NULL;
 
         result.seconds = stop_watch.get_elapsed_microseconds() / 1000000;
-        str = mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS (%u seconds): %" PRId64" bytes (%s)\n", task.remote_host_ip.c_str(), result.seconds, file_size, task.source_filepath.c_str());
+        str = mooon::utils::CStringUtils::format_string("[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS (%u seconds): %" PRId64" bytes, %s (%s)\n", task.remote_host_ip.c_str(), result.seconds, file_size, mode.c_str(), task.source_filepath.c_str());
         screen += str;
         if (!thread)
             fprintf(stdout, "%s", str.c_str());
@@ -451,6 +538,8 @@ void mooon_upload(bool thread, const struct UploadTask& task)
     catch (mooon::sys::CSyscallException& ex)
     {
         result.seconds = stop_watch.get_elapsed_microseconds() / 1000000;
+        if (libssh2 != NULL)
+            task.libssh2_pool->put(libssh2, true);
 
         if (color)
         {
@@ -468,6 +557,8 @@ void mooon_upload(bool thread, const struct UploadTask& task)
     catch (mooon::utils::CException& ex)
     {
         result.seconds = stop_watch.get_elapsed_microseconds() / 1000000;
+        if (libssh2 != NULL)
+            task.libssh2_pool->put(libssh2, true);
 
         if (color)
         {
@@ -520,3 +611,489 @@ void CUploadThread::run()
         mooon_upload(true, task);
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////
+static bool compress_source(const char* data, size_t size, std::string* compressed)
+{
+    try
+    {
+        mooon::utils::compress_data(sg_compression, data, size, compressed);
+        return true;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        return false;
+    }
+}
+
+// 求整个文件和各块的MD5，与远端md5sum的输出一样为小写的十六进制
+static std::string md5_hex(const char* data, size_t size)
+{
+    unsigned char digest[16];
+    mooon::utils::CMd5Helper::digest(data, size, digest);
+    return mooon::utils::CStringUtils::to_hex(std::string(reinterpret_cast<const char*>(digest), sizeof(digest)));
+}
+
+static void digest_source(struct SourceFile* source)
+{
+    const char* data = static_cast<const char*>(source->mmap->addr);
+    const size_t size = source->mmap->len;
+
+    source->md5 = md5_hex(data, size);
+    if (mooon::argument::delta->value() != 0)
+    {
+        const size_t block_size = mooon::argument::bs->value();
+        for (size_t offset=0; offset<size; offset+=block_size)
+            source->block_md5s.push_back(md5_hex(data+offset, std::min(block_size, size-offset)));
+    }
+}
+
+bool load_source_files(const std::vector<std::string>& source_files, std::vector<struct SourceFile>* sources)
+{
+    sources->resize(source_files.size());
+    for (std::vector<std::string>::size_type i=0; i<source_files.size(); ++i)
+    {
+        struct SourceFile& source = (*sources)[i];
+        source.filepath = source_files[i];
+        source.mmap = NULL;
+
+        try
+        {
+            if (-1 == stat(source.filepath.c_str(), &source.fileinfo))
+                THROW_SYSCALL_EXCEPTION(mooon::utils::CStringUtils::format_string("stat %s failed", source.filepath.c_str()), errno, "stat");
+            // 空文件在上传时报错
+            if (0 == source.fileinfo.st_size)
+                continue;
+
+            source.mmap = mooon::sys::CMMap::map_read(source.filepath.c_str());
+            if ((mooon::argument::z->value() != 0)
+             && !compress_source(static_cast<const char*>(source.mmap->addr), source.mmap->len, &source.compressed))
+            {
+                fprintf(stderr, "compress %s failed\n", source.filepath.c_str());
+                return false;
+            }
+            if ((2 == mooon::argument::skip->value()) || (mooon::argument::delta->value() != 0))
+                digest_source(&source);
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            fprintf(stderr, "read %s failed: %s\n", source.filepath.c_str(), ex.str().c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void unload_source_files(std::vector<struct SourceFile>* sources)
+{
+    for (std::vector<struct SourceFile>::size_type i=0; i<sources->size(); ++i)
+    {
+        if ((*sources)[i].mmap != NULL)
+            mooon::sys::CMMap::unmap((*sources)[i].mmap);
+    }
+    sources->clear();
+}
+
+// 用单引号括起，供远端shell使用
+static std::string shell_quote(const std::string& str)
+{
+    std::string result = "'";
+    for (std::string::size_type i=0; i<str.size(); ++i)
+    {
+        if ('\'' == str[i])
+            result += "'\\''";
+        else
+            result += str[i];
+    }
+
+    return result + "'";
+}
+
+// 将producer的输出先写到临时文件，producer成功后再改名，避免留下或读到不完整的文件，
+// 须在bash中执行，pipefail使producer中的管道任一环节失败都视为失败
+static std::string get_install_command(const struct SourceFile& source, const std::string& remote_filepath, const std::string& producer)
+{
+    const std::string tmp_filepath = shell_quote(remote_filepath + ".mooon_upload");
+    return "bash -c " + shell_quote(mooon::utils::CStringUtils::format_string(
+        "set -o pipefail; %s > %s && chmod %o %s && mv -f %s %s",
+        producer.c_str(), tmp_filepath.c_str(), static_cast<unsigned int>(source.fileinfo.st_mode & 0777), tmp_filepath.c_str(),
+        tmp_filepath.c_str(), shell_quote(remote_filepath).c_str()));
+}
+
+void upload_to_host(mooon::net::CLibssh2* libssh2, const struct SourceFile& source, const std::string& remote_filepath)
+{
+    if (NULL == source.mmap)
+        THROW_EXCEPTION("empty file", -1); // 阻止空文件
+
+    if (0 == mooon::argument::z->value())
+    {
+        libssh2->upload(static_cast<const char*>(source.mmap->addr), source.mmap->len, remote_filepath,
+            source.fileinfo.st_mode, source.fileinfo.st_mtime, source.fileinfo.st_atime);
+    }
+    else
+    {
+        int64_t num_bytes = 0;
+        libssh2->upload_compressed(source.compressed.data(), source.compressed.size(), remote_filepath,
+            source.fileinfo.st_mode, sg_compression, &num_bytes);
+    }
+}
+
+// 在远端执行命令，data不为NULL时作为命令的标准输入，返回命令的标准输出，命令失败时抛出异常
+static std::string execute_on_host(mooon::net::CLibssh2* libssh2, const std::string& command, const char* data, size_t size)
+{
+    int exitcode = 0;
+    int64_t num_bytes = 0;
+    std::string exitsignal, errmsg;
+    std::stringstream out;
+
+    if (NULL == data)
+        libssh2->remotely_execute(command, out, &exitcode, &exitsignal, &errmsg, &num_bytes);
+    else
+        libssh2->remotely_execute(command, data, size, out, &exitcode, &exitsignal, &errmsg, &num_bytes);
+    if ((exitcode != 0) || !exitsignal.empty())
+        THROW_EXCEPTION(mooon::utils::CStringUtils::format_string("%s returned %d: %s%s", command.c_str(), exitcode, exitsignal.c_str(), errmsg.c_str()), exitcode);
+    return out.str();
+}
+
+// 远端文件的信息，文件不存在时exists为false
+struct RemoteFileInfo
+{
+    bool exists;
+    int64_t size;
+    int64_t mtime;
+    std::string md5;                     // 指定了“-skip=2”时才有
+    std::vector<std::string> block_md5s; // 指定了“-delta=1”时才有，按“-bs”分块
+};
+
+// 一次远程执行取得比较所需的全部信息：大小和修改时间、整个文件的MD5、各块的MD5，
+// 各块的MD5由“split --filter”对每块执行md5sum得到，split不支持时没有输出，块数对不上时退回完整上传
+static void get_remote_file_info(mooon::net::CLibssh2* libssh2, const std::string& remote_filepath, struct RemoteFileInfo* info)
+{
+    std::string script = mooon::utils::CStringUtils::format_string(
+        "f=%s; [ -f \"$f\" ] || exit 0; stat -c '%%s %%Y' \"$f\" || exit 1", shell_quote(remote_filepath).c_str());
+    if (2 == mooon::argument::skip->value())
+        script += "; md5sum < \"$f\" | cut -c1-32";
+    if (mooon::argument::delta->value() != 0)
+        script += mooon::utils::CStringUtils::format_string("; split -b %u --filter=md5sum \"$f\" 2>/dev/null | cut -c1-32", mooon::argument::bs->value());
+
+    std::vector<std::string> lines;
+    const std::string output = execute_on_host(libssh2, "bash -c " + shell_quote(script), NULL, 0);
+    mooon::utils::CTokener::split(&lines, output, "\n", true);
+
+    info->exists = false;
+    info->size = 0;
+    info->mtime = 0;
+    info->md5.clear();
+    info->block_md5s.clear();
+    if (lines.empty())
+        return;
+
+    std::vector<std::string> fields;
+    if ((mooon::utils::CTokener::split(&fields, lines[0], " ", true) != 2)
+     || !mooon::utils::CStringUtils::string2int(fields[0].c_str(), info->size)
+     || !mooon::utils::CStringUtils::string2int(fields[1].c_str(), info->mtime))
+        THROW_EXCEPTION(mooon::utils::CStringUtils::format_string("invalid stat output of %s: %s", remote_filepath.c_str(), lines[0].c_str()), EINVAL);
+
+    std::vector<std::string>::size_type i = 1;
+    info->exists = true;
+    if ((2 == mooon::argument::skip->value()) && (i < lines.size()))
+        info->md5 = lines[i++];
+    if (mooon::argument::delta->value() != 0)
+        info->block_md5s.assign(lines.begin()+i, lines.end());
+}
+
+// 只发送与远端文件不同的块：本地和远端按“-bs”对齐分块，以MD5比较，
+// 不同的块按顺序拼接成补丁（指定了“-z”时压缩）作为标准输入发给远端，
+// 远端复制旧文件后以dd逐段覆盖到对应位置，截断到新文件的大小，校验整个文件的MD5后再改名，
+// 连续的不同块合并为一次dd，最后一块可能不满一块，总在补丁的末尾，
+// 不同的字节数不小于文件大小时返回false，由调用者完整上传
+static bool delta_upload(mooon::net::CLibssh2* libssh2, const struct SourceFile& source, const std::string& remote_filepath, const struct RemoteFileInfo& info, size_t* num_bytes)
+{
+    const size_t block_size = mooon::argument::bs->value();
+    const size_t num_remote_blocks = static_cast<size_t>((info.size + block_size - 1) / block_size);
+    if ((0 == info.size) || (info.block_md5s.size() != num_remote_blocks))
+        return false;
+
+    const char* data = static_cast<const char*>(source.mmap->addr);
+    const size_t size = source.mmap->len;
+    const std::string patch_filepath = shell_quote(remote_filepath + ".mooon_patch");
+    const std::string tmp_filepath = shell_quote(remote_filepath + ".mooon_upload");
+    std::string patch, dd;
+
+    for (size_t i=0; i<source.block_md5s.size();)
+    {
+        if ((i < info.block_md5s.size()) && (source.block_md5s[i] == info.block_md5s[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        // 连续的不同块
+        size_t j = i + 1;
+        while ((j < source.block_md5s.size()) && ((j >= info.block_md5s.size()) || (source.block_md5s[j] != info.block_md5s[j])))
+            ++j;
+
+        const size_t offset = i * block_size;
+        const size_t bytes = std::min(j * block_size, size) - offset;
+        dd += mooon::utils::CStringUtils::format_string(
+            "dd if=%s of=%s bs=%zu skip=%zu seek=%zu count=%zu conv=notrunc status=none; ",
+            patch_filepath.c_str(), tmp_filepath.c_str(), block_size, patch.size() / block_size, i, j - i);
+        patch.append(data + offset, bytes);
+        i = j;
+    }
+    if (patch.size() >= size)
+        return false;
+
+    std::string compressed;
+    const bool compress = (mooon::argument::z->value() != 0) && !patch.empty();
+    if (compress)
+        mooon::utils::compress_data(sg_compression, patch.data(), patch.size(), &compressed);
+    const std::string receive = compress? (std::string(mooon::utils::get_compression_name(sg_compression)) + " -dc"): std::string("cat");
+    const std::string script = mooon::utils::CStringUtils::format_string(
+        "set -e -o pipefail; trap 'rm -f %s %s' EXIT; %s > %s; cp -f %s %s; %struncate -s %zu %s; "
+        "[ \"$(md5sum < %s | cut -c1-32)\" = %s ]; chmod %o %s; touch -m -d @%ld %s; mv -f %s %s",
+        patch_filepath.c_str(), tmp_filepath.c_str(), receive.c_str(), patch_filepath.c_str(), shell_quote(remote_filepath).c_str(), tmp_filepath.c_str(),
+        dd.c_str(), size, tmp_filepath.c_str(),
+        tmp_filepath.c_str(), source.md5.c_str(), static_cast<unsigned int>(source.fileinfo.st_mode & 0777), tmp_filepath.c_str(),
+        static_cast<long>(source.fileinfo.st_mtime), tmp_filepath.c_str(), tmp_filepath.c_str(), shell_quote(remote_filepath).c_str());
+
+    const std::string& input = compress? compressed: patch;
+    execute_on_host(libssh2, "bash -c " + shell_quote(script), input.data(), input.size());
+    *num_bytes = input.size();
+    return true;
+}
+
+std::string sync_to_host(mooon::net::CLibssh2* libssh2, const struct SourceFile& source, const std::string& remote_filepath)
+{
+    if (NULL == source.mmap)
+        THROW_EXCEPTION("empty file", -1); // 阻止空文件
+
+    const int skip = mooon::argument::skip->value();
+    const bool delta = mooon::argument::delta->value() != 0;
+    if ((0 == skip) && !delta)
+    {
+        upload_to_host(libssh2, source, remote_filepath);
+        return std::string("full");
+    }
+
+    struct RemoteFileInfo info;
+    get_remote_file_info(libssh2, remote_filepath, &info);
+    if (info.exists && (info.size == source.fileinfo.st_size))
+    {
+        if ((1 == skip) && (info.mtime == source.fileinfo.st_mtime))
+            return std::string("skipped (same size and mtime)");
+        if ((2 == skip) && (info.md5 == source.md5))
+            return std::string("skipped (same md5)");
+    }
+
+    size_t num_bytes = 0;
+    if (delta && info.exists && delta_upload(libssh2, source, remote_filepath, info, &num_bytes))
+        return mooon::utils::CStringUtils::format_string("delta %zu bytes", num_bytes);
+
+    upload_to_host(libssh2, source, remote_filepath);
+    if ((1 == skip) && (mooon::argument::z->value() != 0))
+    {
+        // 解压上传的不保留修改时间，补上以便下次比较
+        execute_on_host(libssh2, mooon::utils::CStringUtils::format_string(
+            "touch -m -d @%ld %s", static_cast<long>(source.fileinfo.st_mtime), shell_quote(remote_filepath).c_str()), NULL, 0);
+    }
+    return std::string("full");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 接力的一跳：parent为NULL时由本机直接上传，否则child在rport上监听，parent将其文件发给child
+struct RelayHop
+{
+    const std::string* parent;
+    const std::string* child;
+    int port;
+    const std::string* user;
+    const std::string* password;
+    const struct SourceFile* source;
+    std::string remote_filepath;
+    mooon::net::CLibssh2Pool* libssh2_pool;
+    struct ResultInfo* result;
+    std::string errmsg;
+};
+
+// 在host上执行命令，出错时将出错信息存入errmsg
+static bool relay_execute(const struct RelayHop* hop, const std::string& host, const std::string& command, std::string* errmsg)
+{
+    mooon::net::CLibssh2* libssh2 = NULL;
+    try
+    {
+        int exitcode = 0;
+        int64_t num_bytes = 0;
+        std::string exitsignal, errmsg_;
+        std::stringstream out;
+
+        libssh2 = hop->libssh2_pool->get(host, hop->port, *hop->user, *hop->password);
+        libssh2->remotely_execute(command, out, &exitcode, &exitsignal, &errmsg_, &num_bytes);
+        hop->libssh2_pool->put(libssh2);
+        if ((0 == exitcode) && exitsignal.empty())
+            return true;
+        *errmsg = mooon::utils::CStringUtils::format_string("%s returned %d on %s %s", command.c_str(), exitcode, host.c_str(), exitsignal.c_str());
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        if (libssh2 != NULL)
+            hop->libssh2_pool->put(libssh2, true);
+        *errmsg = ex.str();
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        if (libssh2 != NULL)
+            hop->libssh2_pool->put(libssh2, true);
+        *errmsg = ex.str();
+    }
+
+    return false;
+}
+
+static void relay_listen(struct RelayHop* hop)
+{
+    // 兼容传统nc（-l -p PORT）和OpenBSD nc（-l PORT），无人连接时10分钟后放弃
+    const bool compress = mooon::argument::z->value() != 0;
+    const std::string listen = mooon::utils::CStringUtils::format_string(
+        "timeout 600 sh -c '{ nc -l -p %d 2>/dev/null || nc -l %d; }'%s",
+        mooon::argument::rport->value(), mooon::argument::rport->value(),
+        compress? (std::string(" | ") + mooon::utils::get_compression_name(sg_compression) + " -dc").c_str(): "");
+    const std::string command = get_install_command(*hop->source, hop->remote_filepath, listen);
+    (void)relay_execute(hop, *hop->child, command, &hop->errmsg);
+}
+
+static void relay_hop(struct RelayHop* hop)
+{
+    mooon::sys::CStopWatch stop_watch;
+    hop->result->ip = *hop->child;
+    hop->result->source = hop->source->filepath;
+
+    if (NULL == hop->parent)
+    {
+        mooon::net::CLibssh2* libssh2 = NULL;
+        try
+        {
+            libssh2 = hop->libssh2_pool->get(*hop->child, hop->port, *hop->user, *hop->password);
+            upload_to_host(libssh2, *hop->source, hop->remote_filepath);
+            hop->libssh2_pool->put(libssh2);
+            hop->errmsg.clear();
+        }
+        catch (mooon::sys::CSyscallException& ex)
+        {
+            if (libssh2 != NULL)
+                hop->libssh2_pool->put(libssh2, true);
+            hop->errmsg = ex.str();
+        }
+        catch (mooon::utils::CException& ex)
+        {
+            if (libssh2 != NULL)
+                hop->libssh2_pool->put(libssh2, true);
+            hop->errmsg = ex.str();
+        }
+    }
+    else
+    {
+        // 等监听起来后再发，未起来时重试
+        const bool compress = mooon::argument::z->value() != 0;
+        const std::string send = mooon::utils::CStringUtils::format_string(
+            "%s %s > /dev/tcp/%s/%d", compress? (std::string(mooon::utils::get_compression_name(sg_compression)) + " -c").c_str(): "cat", shell_quote(hop->remote_filepath).c_str(),
+            hop->child->c_str(), mooon::argument::rport->value());
+        const std::string command = "bash -c " + shell_quote(
+            "for i in 1 2 3 4 5 6 7 8 9 10; do sleep 1; " + send + " 2>/dev/null && exit 0; done; exit 1");
+        std::string errmsg;
+
+        mooon::sys::CThreadEngine listener(mooon::sys::bind(&relay_listen, hop));
+        const bool sent = relay_execute(hop, *hop->parent, command, &errmsg);
+        listener.join();
+        if (!sent)
+            hop->errmsg = errmsg;
+    }
+
+    hop->result->seconds = stop_watch.get_elapsed_microseconds() / 1000000;
+    hop->result->success = hop->errmsg.empty();
+}
+
+void mooon_upload_relay(std::vector<struct ResultInfo>& results, const std::vector<std::string>& hosts_ip, int port, const std::string& user, const std::string& password, const std::vector<struct SourceFile>& sources, const std::string& directory, int num_threads, mooon::net::CLibssh2Pool* libssh2_pool)
+{
+    const size_t num_hosts = hosts_ip.size();
+    const int num_direct = (num_threads < 1)? 1: num_threads;
+
+    for (std::vector<struct SourceFile>::size_type j=0; j<sources.size(); ++j)
+    {
+        const std::string remote_filepath = directory + std::string("/") + mooon::utils::CStringUtils::extract_filename(sources[j].filepath);
+        std::vector<size_t> holders; // 已收到文件的主机
+        std::vector<size_t> pending; // 尚未收到文件的主机
+        std::vector<bool> relay_failed(num_hosts, false);
+        for (size_t i=num_hosts; i>0; --i)
+            pending.push_back(i - 1);
+
+        for (int round=1; !pending.empty(); ++round)
+        {
+            // 本机每轮直接发num_direct份，每台已收到的主机每轮转发一份，
+            // 转发失败过的主机只由本机直接发
+            std::vector<struct RelayHop> hops;
+            std::vector<size_t> children;
+            for (size_t h=0; (h<holders.size()+num_direct) && !pending.empty(); ++h)
+            {
+                const bool direct = (h >= holders.size());
+                size_t child = pending.back();
+                if (!direct && relay_failed[child])
+                {
+                    std::vector<size_t>::iterator iter = pending.end();
+                    while ((iter != pending.begin()) && relay_failed[*(iter-1)])
+                        --iter;
+                    if (iter == pending.begin())
+                        continue;
+                    child = *(iter-1);
+                    pending.erase(iter-1);
+                }
+                else
+                {
+                    pending.pop_back();
+                }
+
+                struct RelayHop hop;
+                hop.parent = direct? NULL: &hosts_ip[holders[h]];
+                hop.child = &hosts_ip[child];
+                hop.port = port;
+                hop.user = &user;
+                hop.password = &password;
+                hop.source = &sources[j];
+                hop.remote_filepath = remote_filepath;
+                hop.libssh2_pool = libssh2_pool;
+                hop.result = &results[child*sources.size() + j];
+                hops.push_back(hop);
+                children.push_back(child);
+            }
+
+            std::vector<mooon::sys::CThreadEngine*> thread_engines(hops.size());
+            for (std::vector<struct RelayHop>::size_type k=0; k<hops.size(); ++k)
+                thread_engines[k] = new mooon::sys::CThreadEngine(mooon::sys::bind(&relay_hop, &hops[k]));
+            for (std::vector<struct RelayHop>::size_type k=0; k<hops.size(); ++k)
+            {
+                thread_engines[k]->join();
+                delete thread_engines[k];
+
+                const struct RelayHop& hop = hops[k];
+                if (hop.errmsg.empty())
+                {
+                    holders.push_back(children[k]);
+                    fprintf(stdout, "[" PRINT_COLOR_YELLOW"%s" PRINT_COLOR_NONE"] SUCCESS (round %d from %s): %s\n", hop.child->c_str(), round, (NULL == hop.parent)? "local": hop.parent->c_str(), hop.source->filepath.c_str());
+                }
+                else if ((hop.parent != NULL) && !relay_failed[children[k]])
+                {
+                    // 转发失败的改由本机直接发
+                    relay_failed[children[k]] = true;
+                    pending.push_back(children[k]);
+                    fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] relay from %s failed: %s\n", hop.child->c_str(), hop.parent->c_str(), hop.errmsg.c_str());
+                }
+                else
+                {
+                    fprintf(stderr, "[" PRINT_COLOR_RED"%s" PRINT_COLOR_NONE"] failed: %s (%s)\n", hop.child->c_str(), hop.errmsg.c_str(), hop.source->filepath.c_str());
+                }
+            }
+        }
+    }
+}
@@ -20,14 +20,73 @@
 #include <mysql/mysql.h>
 #include <mooon/sys/mysql_db.h>
 #endif // MOOON_HAVE_MYSQL
+#include <mooon/sys/stop_watch.h>
+#include <mooon/utils/string_simd.h>
 #include <mooon/utils/tokener.h>
 
 static void usage()
 {
     fprintf(stderr, "usage1: mysql_escape_test 'username@IP:port#password' 'sql'\n");
     fprintf(stderr, "usage2: mysql_escape_test 'username@IP:port#password' 'sql' 'charset'\n");
+    fprintf(stderr, "usage3: mysql_escape_test --benchmark [size]\n");
 }
 
+#if MOOON_HAVE_MYSQL==1
+// 生成size字节的数据，约每escape_interval字节有一个须转义的字节（0表示没有）
+static std::string make_benchmark_data(size_t size, size_t escape_interval)
+{
+    static const char escape_chars[] = { '\'', '"', '\\', '\n', '\r', '\0', '\032' };
+    std::string data(size, '\0');
+
+    for (size_t i=0; i<size; ++i)
+    {
+        if ((escape_interval > 0) && (0 == random() % escape_interval))
+            data[i] = escape_chars[random() % sizeof(escape_chars)];
+        else
+            data[i] = static_cast<char>('a' + random() % 26);
+    }
+    return data;
+}
+
+static void print_throughput(const char* name, size_t bytes, uint64_t microseconds)
+{
+    fprintf(stdout, "    %-24s %8.1f MB/s\n", name, (microseconds > 0)? bytes/static_cast<double>(microseconds): 0.0);
+}
+
+// 对比mysql_escape_string和向量化的转义，不需要连接DB
+static void benchmark(size_t size)
+{
+    static const size_t escape_intervals[] = { 0, 1000, 100, 10 };
+    const int loops = static_cast<int>(std::max<size_t>(1, (256*1024*1024) / size)); // 每种共转义约256MB
+    std::string escaped(mooon::sys::CMySQLConnection::get_escape_size(size)+1, '\0');
+    std::string escaped_str;
+
+    for (size_t k=0; k<sizeof(escape_intervals)/sizeof(escape_intervals[0]); ++k)
+    {
+        const std::string data = make_benchmark_data(size, escape_intervals[k]);
+        const size_t bytes = data.size() * loops;
+        size_t length1 = 0, length2 = 0;
+        mooon::sys::CStopWatch stop_watch;
+
+        fprintf(stdout, "size=%zu, escape_interval=%zu, loops=%d:\n", size, escape_intervals[k], loops);
+        for (int i=0; i<loops; ++i)
+            length1 = mysql_escape_string(const_cast<char*>(escaped.data()), data.data(), static_cast<unsigned long>(data.size()));
+        print_throughput("mysql_escape_string", bytes, stop_watch.get_elapsed_microseconds());
+
+        for (int i=0; i<loops; ++i)
+            mooon::sys::CMySQLConnection::escape_string(data, &escaped_str);
+        print_throughput("escape_string(string)", bytes, stop_watch.get_elapsed_microseconds());
+
+        for (int i=0; i<loops; ++i)
+            length2 = mooon::utils::CStringSimd::escape_mysql(data.data(), data.size(), const_cast<char*>(escaped.data()));
+        print_throughput("escape_mysql(buffer)", bytes, stop_watch.get_elapsed_microseconds());
+
+        if ((length1 != length2) || (escaped_str.size() != length2) || (0 != memcmp(escaped.data(), escaped_str.data(), length2)))
+            fprintf(stderr, "    MISMATCH: %zu, %zu, %zu\n", length1, escaped_str.size(), length2);
+    }
+}
+#endif // MOOON_HAVE_MYSQL
+
 static std::string escape_string(MYSQL* mysql, const std::string& src)
 {
 #if MOOON_HAVE_MYSQL==1
@@ -92,6 +151,23 @@ int main(int argc, char* argv[])
 #if MOOON_HAVE_MYSQL==1
     printf("MYSQL_SERVER_VERSION: %s\n", MYSQL_SERVER_VERSION);
 
+    // mysql_escape_test --benchmark [size]
+    if ((argc >= 2) && (0 == strcmp(argv[1], "--benchmark")))
+    {
+        const size_t size = (argc >= 3)? static_cast<size_t>(atoll(argv[2])): 0;
+        if (size > 0)
+        {
+            benchmark(size);
+        }
+        else
+        {
+            benchmark(64);
+            benchmark(4096);
+            benchmark(1024*1024);
+        }
+        return 0;
+    }
+
     if ((argc != 3) && (argc != 4))
     {
         usage();
@@ -8,13 +8,39 @@
 // 失败信息标识为“FAILED”，成功信息标识为“SUCCESS”。
 // 如果数据不为空，则在成功标识“SUCCESS”后紧跟第一个字段的最新值，
 // 如果这是一个自增字段值，则可借助这个值实现增量复制。
+// 源表以游标方式逐行读取，不将整个结果集读入内存，每“--batch”行写一次目标表。
+//
+// 指定“--parallel”时不使用“--sql”，而是按整数主键“--pkey”将源表“--stable”均分成多个区间，
+// 每个区间一个读线程和一个写线程，读线程按主键分页读源表，写线程写目标表，
+// 两者之间最多积压“--queue”页，每页“--batch”行。
+// 进度（各区间已写入的最大主键）保存在“--checkpoint”指定的文件中，
+// 中断后以相同的参数再次运行，即从文件记录的进度继续复制，
+// 成功信息“SUCCESS”后紧跟主键的最大值。
+//
+// 指定“--dfile”时不写目标表，而是将源表导出到文件（可压缩），
+// 按“--sql”导出为一个文件，或按“--parallel”每个区间一个线程导出一个文件，
+// 文件名为“<--dfile>.<区间序号>.<tsv|csv>[.gz|.zst|.lz4]”，格式由“--format”指定：
+// tsv为LOAD DATA的默认格式（以“\N”表示NULL，以“\”转义），csv遵循RFC 4180（以不带引号的NULL表示NULL）。
+// 指定“--sfile”时不读源表，而是以LOAD DATA LOCAL INFILE将匹配的文件（可以是导出的压缩文件）导入目标表，
+// “--parallel”为同时导入的线程数，目标库须打开local_infile。
+#include <mooon/sys/db_batch_inserter.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/mysql_db.h>
 #include <mooon/sys/signal_handler.h>
 #include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
+#include <mooon/utils/compressor.h>
 #include <mooon/utils/print_color.h>
+#include <mooon/utils/scoped_ptr.h>
 #include <mooon/utils/string_utils.h>
+#include <deque>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <unistd.h>
 
 // Source database
 STRING_ARG_DEFINE(shost, "127.0.0.1", "Source database host, example: --shost=127.0.0.1");
@@ -47,25 +73,278 @@ BOOL_STRING_ARG_DEFINE(ignore, "false", "If true errors that occur while executi
 // 显示详细信息
 BOOL_STRING_ARG_DEFINE(verbose, "false", "Displays runtime details, example: --verbose=true");
 
-// 单次查询数据条数硬限制（0表示不限制）
-INTEGER_ARG_DEFINE(int, hdlimit, 10000, 0, std::numeric_limits<int>::max(), "The number of records for a single query, example: --hdlimit=100000");
+// 单条INSERT语句的行数（0表示不限制，所有行以一条INSERT写入）
+INTEGER_ARG_DEFINE(int, batch, 10000, 0, std::numeric_limits<int>::max(), "The number of records for a single INSERT, example: --batch=1000");
+
+// 并行复制的分区数（0表示不并行，按--sql复制）
+INTEGER_ARG_DEFINE(int, parallel, 0, 0, 64, "The number of partitions to copy in parallel by --pkey ranges of --stable, --sql is ignored if not 0, example: --parallel=8");
+STRING_ARG_DEFINE(stable, "", "Source table for --parallel, example: --stable=test");
+STRING_ARG_DEFINE(pkey, "id", "Integer primary key of --stable for --parallel, example: --pkey=id");
+STRING_ARG_DEFINE(sfields, "*", "Source table fields for --parallel, example: --sfields=a,b,c,d");
+STRING_ARG_DEFINE(swhere, "", "Additional condition of --stable for --parallel, example: --swhere='f_state=1'");
+INTEGER_ARG_DEFINE(int, queue, 4, 1, 1000, "The max number of pages pending between reader and writer of a partition, example: --queue=4");
+STRING_ARG_DEFINE(checkpoint, "", "The file to save progress of --parallel, resume from it if it exists, example: --checkpoint=/tmp/test.checkpoint");
+INTEGER_ARG_DEFINE(int, report, 10, 0, 3600, "Interval seconds to report progress of --parallel, 0 means no report, example: --report=10");
+
+// 导出到文件和从文件导入
+STRING_ARG_DEFINE(dfile, "", "Export source table to files with this prefix instead of destination table, example: --dfile=/data/test");
+STRING_ARG_DEFINE(sfile, "", "Load files matching this glob pattern into destination table by LOAD DATA LOCAL INFILE, example: --sfile='/data/test.*.tsv.gz'");
+STRING_ARG_DEFINE(format, "tsv", "Format of --dfile and --sfile, tsv or csv, example: --format=csv");
+STRING_ARG_DEFINE(compression, "none", "Compression of --dfile, one of none, gzip, zstd and lz4, --sfile is detected automatically, example: --compression=zstd");
+
+// 并行复制的一个分区，主键区间为[lo, hi]
+struct CopyPartition
+{
+    int index;
+    int64_t lo;
+    int64_t hi;
+    int64_t done;           // 已写入目标表的最大主键，初始为lo-1，等于hi时表示已完成
+    uint64_t rows;          // 本次运行写入的行数
+    uint64_t microseconds;  // 本次运行的耗时
+};
+
+class CPartitionCopyer;
+class CPartitionExporter;
+class CFileLoader;
 
 class CTableCopyer
 {
+    friend class CPartitionCopyer;
+    friend class CPartitionExporter;
+    friend class CFileLoader;
+
 public:
     int copy();
 
 private:
+    int copy_parallel();
+    int export_files();
+    int load_files();
+    static void report_progress(const std::vector<CopyPartition>& partitions);
     bool init();
-    bool init_source_mysql();
-    bool init_destination_mysql();
+    static bool init_source_mysql(mooon::sys::CMySQLConnection* source_mysql);
+    static bool init_destination_mysql(mooon::sys::CMySQLConnection* destination_mysql);
+    void insert_values(const std::vector<std::string>& values, std::string* insertsql);
     void print_cost(_IO_FILE* stdxxx, mooon::sys::CStopWatch& stopwatch);
 
 private:
+    int split_partitions(std::vector<CopyPartition>* partitions);
+    bool load_checkpoint(std::vector<CopyPartition>* partitions);
+    void save_checkpoint(const std::vector<CopyPartition>& partitions);
+
+private:
+    mooon::sys::CMySQLConnection _source_mysql;
+    mooon::sys::CMySQLConnection _destination_mysql;
+};
+
+// 一个分区的读写流水线
+class CPartitionCopyer
+{
+public:
+    CPartitionCopyer(const CopyPartition& partition);
+    ~CPartitionCopyer();
+
+    bool start();
+    void stop();
+    bool is_finished() const;
+    bool is_failed() const;
+    const std::string& get_error() const { return _error; } // 线程结束后才可调用
+    void get_progress(CopyPartition* partition) const;
+
+private:
+    // 读线程读出的一页，每行第一列为主键
+    struct CopyPage
+    {
+        mooon::sys::DBTable rows;
+        int64_t last_key;
+    };
+
+private:
+    void read();
+    void write();
+    bool push(CopyPage* page);
+    CopyPage* pop();
+    void fail(const std::string& tag, mooon::sys::CDBException& ex);
+
+private:
+    CopyPartition _partition;
     mooon::sys::CMySQLConnection _source_mysql;
     mooon::sys::CMySQLConnection _destination_mysql;
+    mooon::sys::CStopWatch _stopwatch;
+    mooon::sys::CThreadEngine* _reader;
+    mooon::sys::CThreadEngine* _writer;
+
+private:
+    mutable mooon::sys::CLock _lock;
+    mooon::sys::CEvent _not_empty;
+    mooon::sys::CEvent _not_full;
+    std::deque<CopyPage*> _pages; // NULL表示读完
+    bool _finished;
+    bool _failed;
+    std::string _error;
+};
+
+// 以缓冲写文件，按需压缩
+class CExportFile
+{
+public:
+    CExportFile();
+    ~CExportFile();
+
+    bool open(const std::string& filepath, mooon::utils::compression_t compression);
+    bool write(const std::string& data);
+    bool close();
+    const std::string& get_error() const { return _error; }
+
+private:
+    bool write_file(const std::string& data);
+
+private:
+    std::string _filepath;
+    int _fd;
+    mooon::utils::ScopedPtr<mooon::utils::CCompressor> _compressor;
+    std::string _compressed;
+    std::string _error;
+};
+
+// 导出一个分区到一个文件，--sql时只有一个分区
+class CPartitionExporter
+{
+public:
+    CPartitionExporter(const CopyPartition& partition, const std::string& filepath);
+    ~CPartitionExporter();
+
+    bool start();
+    void stop();
+    bool is_finished() const;
+    bool is_failed() const;
+    const std::string& get_error() const { return _error; } // 线程结束后才可调用
+    void get_progress(CopyPartition* partition) const;
+
+private:
+    void run();
+    void fail(const std::string& error);
+
+private:
+    CopyPartition _partition;
+    const std::string _filepath;
+    mooon::sys::CMySQLConnection _source_mysql;
+    mooon::sys::CStopWatch _stopwatch;
+    mooon::sys::CThreadEngine* _thread;
+
+private:
+    mutable mooon::sys::CLock _lock;
+    bool _finished;
+    bool _failed;
+    std::string _error;
+};
+
+// LOAD DATA LOCAL INFILE的数据源，边读边解压
+class CInfileReader: public mooon::sys::CLocalInfileReader
+{
+public:
+    CInfileReader(const std::string& filepath);
+    ~CInfileReader();
+
+    bool open();
+    virtual int read(char* buffer, unsigned int size);
+    virtual std::string get_error() const { return _error; }
+
+private:
+    bool fill();
+
+private:
+    const std::string _filepath;
+    int _fd;
+    bool _eof;
+    bool _detected;
+    mooon::utils::ScopedPtr<mooon::utils::CDecompressor> _decompressor;
+    std::string _input;
+    std::string _output;  // 待交给客户端库的数据
+    std::string::size_type _offset;
+    std::string _error;
+};
+
+// 多个线程从文件列表中取文件导入目标表
+class CFileLoader
+{
+public:
+    CFileLoader(const std::vector<std::string>& filepaths);
+    ~CFileLoader();
+
+    // 返回导入失败的文件数
+    int load(int thread_number);
+    uint64_t get_rows() const { return _rows; }
+
+private:
+    void run();
+    bool next(std::string* filepath);
+
+private:
+    const std::vector<std::string>& _filepaths;
+    mooon::sys::CLock _lock;
+    std::vector<std::string>::size_type _index;
+    uint64_t _rows;
+    int _failed_number;
 };
 
+// 按--format追加一个字段，tsv为LOAD DATA的默认格式，csv遵循RFC 4180
+static void append_field(bool csv, const mooon::sys::DBField& field, std::string* line)
+{
+    if (csv)
+    {
+        if (field.is_null)
+        {
+            line->append("NULL");
+            return;
+        }
+
+        // 值恰为NULL时须加引号，否则导入时被当作NULL
+        bool quoted = (4 == field.size) && (0 == memcmp(field.data, "NULL", 4));
+        for (size_t i=0; !quoted && i<field.size; ++i)
+        {
+            const char c = field.data[i];
+            quoted = (',' == c) || ('"' == c) || ('\n' == c) || ('\r' == c);
+        }
+        if (!quoted)
+        {
+            line->append(field.data, field.size);
+            return;
+        }
+
+        line->push_back('"');
+        for (size_t i=0; i<field.size; ++i)
+        {
+            if ('"' == field.data[i])
+                line->push_back('"');
+            line->push_back(field.data[i]);
+        }
+        line->push_back('"');
+    }
+    else
+    {
+        if (field.is_null)
+        {
+            line->append("\\N");
+            return;
+        }
+
+        for (size_t i=0; i<field.size; ++i)
+        {
+            const char c = field.data[i];
+            switch (c)
+            {
+            case '\\': line->append("\\\\"); break;
+            case '\t':  line->append("\\t"); break;
+            case '\n':  line->append("\\n"); break;
+            case '\r':  line->append("\\r"); break;
+            case '\0':  line->append("\\0"); break;
+            default:    line->push_back(c); break;
+            }
+        }
+    }
+}
+
 static void usage()
 {
     fprintf(stderr, "Exit codes:\n");
@@ -92,78 +371,135 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    // --shost
-    if (mooon::argument::shost->value().empty())
-    {
-        fprintf(stderr, "Parameter[--shost] is not set.\n\n");
-        usage();
-        return 1;
-    }
-    // --sname
-    if (mooon::argument::sname->value().empty())
+    // --format
+    if ((mooon::argument::format->value() != "tsv") && (mooon::argument::format->value() != "csv"))
     {
-        fprintf(stderr, "Parameter[--sname] is not set.\n\n");
+        fprintf(stderr, "Parameter[--format] is invalid: %s.\n\n", mooon::argument::format->c_value());
         usage();
         return 1;
     }
-    // --suser
-    if (mooon::argument::suser->value().empty())
+    // --compression
+    try
     {
-        fprintf(stderr, "Parameter[--suser] is not set.\n\n");
-        usage();
-        return 1;
+        const mooon::utils::compression_t compression = mooon::utils::get_compression_by_name(mooon::argument::compression->value());
+        if (!mooon::utils::is_compression_supported(compression))
+        {
+            fprintf(stderr, "Parameter[--compression] is not supported: %s.\n\n", mooon::argument::compression->c_value());
+            usage();
+            return 1;
+        }
     }
-    // --spassword
-    if (mooon::argument::spassword->value().empty())
+    catch (mooon::utils::CException& ex)
     {
-        fprintf(stderr, "Parameter[--spassword] is not set.\n\n");
+        fprintf(stderr, "Parameter[--compression] is invalid: %s.\n\n", ex.str().c_str());
         usage();
         return 1;
     }
-    // --sql
-    if (mooon::argument::sql->value().empty())
+    if (!mooon::argument::dfile->value().empty() && !mooon::argument::sfile->value().empty())
     {
-        fprintf(stderr, "Parameter[--sql] is not set.\n\n");
+        fprintf(stderr, "Parameter[--dfile] and parameter[--sfile] can not be set at the same time.\n\n");
         usage();
         return 1;
     }
-    if (mooon::argument::test->is_false())
+
+    // 从文件导入时不读源表
+    if (mooon::argument::sfile->value().empty())
     {
-        // --dhost
-        if (mooon::argument::dhost->value().empty())
+        // --shost
+        if (mooon::argument::shost->value().empty())
+        {
+            fprintf(stderr, "Parameter[--shost] is not set.\n\n");
+            usage();
+            return 1;
+        }
+        // --sname
+        if (mooon::argument::sname->value().empty())
         {
-            fprintf(stderr, "Parameter[--dhost] is not set.\n\n");
+            fprintf(stderr, "Parameter[--sname] is not set.\n\n");
             usage();
             return 1;
         }
-        // --dname
-        if (mooon::argument::dname->value().empty())
+        // --suser
+        if (mooon::argument::suser->value().empty())
         {
-            fprintf(stderr, "Parameter[--dname] is not set.\n\n");
+            fprintf(stderr, "Parameter[--suser] is not set.\n\n");
             usage();
             return 1;
         }
-        // --duser
-        if (mooon::argument::duser->value().empty())
+        // --spassword
+        if (mooon::argument::spassword->value().empty())
         {
-            fprintf(stderr, "Parameter[--duser] is not set.\n\n");
+            fprintf(stderr, "Parameter[--spassword] is not set.\n\n");
             usage();
             return 1;
         }
-        // --dpassword
-        if (mooon::argument::dpassword->value().empty())
+        // --sql
+        if ((0 == mooon::argument::parallel->value()) && mooon::argument::sql->value().empty())
         {
-            fprintf(stderr, "Parameter[--dpassword] is not set.\n\n");
+            fprintf(stderr, "Parameter[--sql] is not set.\n\n");
             usage();
             return 1;
         }
     }
-    // --dtable
-    if (mooon::argument::dtable->value().empty())
+    // 导出到文件时不写目标表
+    if (mooon::argument::dfile->value().empty())
     {
-        fprintf(stderr, "Parameter[--dtable] is not set.\n\n");
-        usage();
-        return 1;
+        if (mooon::argument::test->is_false())
+        {
+            // --dhost
+            if (mooon::argument::dhost->value().empty())
+            {
+                fprintf(stderr, "Parameter[--dhost] is not set.\n\n");
+                usage();
+                return 1;
+            }
+            // --dname
+            if (mooon::argument::dname->value().empty())
+            {
+                fprintf(stderr, "Parameter[--dname] is not set.\n\n");
+                usage();
+                return 1;
+            }
+            // --duser
+            if (mooon::argument::duser->value().empty())
+            {
+                fprintf(stderr, "Parameter[--duser] is not set.\n\n");
+                usage();
+                return 1;
+            }
+            // --dpassword
+            if (mooon::argument::dpassword->value().empty())
+            {
+                fprintf(stderr, "Parameter[--dpassword] is not set.\n\n");
+                usage();
+                return 1;
+            }
+        }
+        // --dtable
+        if (mooon::argument::dtable->value().empty())
+        {
+            fprintf(stderr, "Parameter[--dtable] is not set.\n\n");
+            usage();
+            return 1;
+        }
+    }
+
+    if (mooon::argument::sfile->value().empty() && (mooon::argument::parallel->value() > 0))
+    {
+        // --stable
+        if (mooon::argument::stable->value().empty())
+        {
+            fprintf(stderr, "Parameter[--stable] is not set.\n\n");
+            usage();
+            return 1;
+        }
+        // --pkey
+        if (mooon::argument::pkey->value().empty())
+        {
+            fprintf(stderr, "Parameter[--pkey] is not set.\n\n");
+            usage();
+            return 1;
+        }
     }
 
     return CTableCopyer().copy();
@@ -179,6 +515,12 @@ int CTableCopyer::copy()
     std::string insertsql;
     mooon::sys::CStopWatch stopwatch;
 
+    if (!mooon::argument::sfile->value().empty())
+        return load_files();
+    if (!mooon::argument::dfile->value().empty())
+        return export_files();
+    if (mooon::argument::parallel->value() > 0)
+        return copy_parallel();
     if (!init())
     {
         print_cost(stderr, stopwatch);
@@ -187,101 +529,70 @@ int CTableCopyer::copy()
     }
     try
     {
-        const bool have_limit = strcasestr(mooon::argument::sql->c_value(), " LIMIT ") != NULL; // 是否已含有LIMIT
         std::vector<std::string> values;
-        std::string values_str;
         std::string first_field;
-        std::string ignore_str;
-        mooon::sys::DBTable dbtable;
+        uint64_t num_rows = 0;
 
-        // 防止单词SELECT数据量过大，强制加上LIMIT硬保护
-        if (have_limit || mooon::argument::hdlimit->value()==0)
-        {
-            querysql = mooon::argument::sql->value();
-        }
-        else
-        {
-            querysql = mooon::utils::CStringUtils::format_string(
-                    "%s LIMIT %d", mooon::argument::sql->c_value(), mooon::argument::hdlimit->value());
-        }
+        querysql = mooon::argument::sql->value();
         if (mooon::argument::verbose->is_true())
         {
             fprintf(stdout, "[SELECTSQL] %s\n", querysql.c_str());
         }
 
         tag = "SELECT_FROM_SOURCE";
-        _source_mysql.query(dbtable, "%s", querysql.c_str());
-        if (dbtable.empty())
-        {
-            fprintf(stderr, "NODATA\n");
-            return 2; // 方便调用者区分错误结束循环
-        }
-        for (mooon::sys::DBTable::size_type row=0; row<dbtable.size(); ++row)
+        mooon::utils::ScopedPtr<mooon::sys::DBCursor> cursor(_source_mysql.open_cursor("%s", querysql.c_str()));
+        while (true)
         {
-            const mooon::sys::DBRow& dbrow = dbtable[row];
-            std::string value;
+            tag = "SELECT_FROM_SOURCE";
+            if (!cursor->fetch())
+                break;
 
-            for (mooon::sys::DBRow::size_type col=0; col<dbrow.size(); ++col)
+            std::string value;
+            for (int col=0; col<cursor->get_field_number(); ++col)
             {
+                const mooon::sys::DBField& field = cursor->get_field(col);
+
                 if (col == 0)
                 {
-                    first_field = dbrow[col];
+                    first_field.assign(field.data, field.size);
                 }
-                if (value.empty())
-                    value = std::string("('") + dbrow[col] + std::string("'");
-                else
-                    value = value + std::string(",'") + dbrow[col] + std::string("'");
+                value.append((col == 0)? "('": ",'");
+                value.append(field.data, field.size);
+                value.append("'");
             }
-            value = value + std::string(")");
+            value.append(")");
             values.push_back(value);
-        }
+            ++num_rows;
 
-        values_str = mooon::utils::CStringUtils::container2string(values, ",");
-        if (mooon::argument::ignore->is_true())
-        {
-            ignore_str = " IGNORE ";
-        }
-        else
-        {
-            ignore_str = " ";
-        }
-        if (mooon::argument::dfields->value().empty() || mooon::argument::dfields->value()=="*")
-        {
-            insertsql = mooon::utils::CStringUtils::format_string(
-                    "INSERT%sINTO %s VALUES %s", ignore_str.c_str(),
-                    mooon::argument::dtable->c_value(), values_str.c_str());
-        }
-        else
-        {
-            insertsql = mooon::utils::CStringUtils::format_string(
-                    "INSERT%sINTO %s (%s) VALUES %s", ignore_str.c_str(),
-                    mooon::argument::dtable->c_value(), mooon::argument::dfields->c_value(), values_str.c_str());
+            // 游标读取期间仍可以写另一个连接上的目标表
+            if ((mooon::argument::batch->value() > 0) && (values.size() >= static_cast<size_t>(mooon::argument::batch->value())))
+            {
+                tag = "INSERT_INTO_DESTINATION";
+                insert_values(values, &insertsql);
+                values.clear();
+            }
         }
-
-        if (mooon::argument::test->is_true() ||
-            mooon::argument::verbose->is_true())
+        if (0 == num_rows)
         {
-            if (insertsql.size() < mooon::SIZE_32K)
-                fprintf(stdout, "[INSERTSQL] %s\n", insertsql.c_str());
-            else
-                fprintf(stdout, "[INSERTSQL] %.*s ... (%zu more than %d)\n",
-                        mooon::SIZE_32K, insertsql.c_str(), insertsql.size(), mooon::SIZE_32K);
+            fprintf(stderr, "NODATA\n");
+            return 2; // 方便调用者区分错误结束循环
         }
-        if (mooon::argument::test->is_false())
+        if (!values.empty())
         {
             tag = "INSERT_INTO_DESTINATION";
-            _destination_mysql.update("%s", insertsql.c_str());
+            insert_values(values, &insertsql);
         }
+
         if (first_field.empty())
         {
             print_cost(stdout, stopwatch);
-            fprintf(stdout, "ROW: %zu\n", dbtable.size());
+            fprintf(stdout, "ROW: %" PRIu64"\n", num_rows);
             fprintf(stdout, "SUCCESS: none\n");
         }
         else
         {
             print_cost(stdout, stopwatch);
-            fprintf(stdout, "ROW: %zu\n", dbtable.size());
+            fprintf(stdout, "ROW: %" PRIu64"\n", num_rows);
             fprintf(stdout, "SUCCESS: %s (The latest value of the first field)\n", first_field.c_str());
         }
         return 0;
@@ -310,23 +621,23 @@ int CTableCopyer::copy()
 bool CTableCopyer::init()
 {
     mooon::sys::CSignalHandler::ignore_signal(SIGPIPE);
-    return (init_source_mysql() && init_destination_mysql());
+    return (init_source_mysql(&_source_mysql) && init_destination_mysql(&_destination_mysql));
 }
 
-bool CTableCopyer::init_source_mysql()
+bool CTableCopyer::init_source_mysql(mooon::sys::CMySQLConnection* source_mysql)
 {
     for (int i=0; i<3; ++i)
     {
         try
         {
-            _source_mysql.set_null_value("");
-            _source_mysql.set_host(mooon::argument::shost->value(), mooon::argument::sport->value());
-            _source_mysql.set_db_name(mooon::argument::sname->value());
-            _source_mysql.set_user(mooon::argument::suser->value(), mooon::argument::spassword->value());
-            _source_mysql.enable_auto_reconnect(true);
-            _source_mysql.set_connect_timeout_seconds(mooon::argument::sconntimeout->value());
-            _source_mysql.set_read_timeout_seconds(mooon::argument::sreadtimeout->value());
-            _source_mysql.open();
+            source_mysql->set_null_value("");
+            source_mysql->set_host(mooon::argument::shost->value(), mooon::argument::sport->value());
+            source_mysql->set_db_name(mooon::argument::sname->value());
+            source_mysql->set_user(mooon::argument::suser->value(), mooon::argument::spassword->value());
+            source_mysql->enable_auto_reconnect(true);
+            source_mysql->set_connect_timeout_seconds(mooon::argument::sconntimeout->value());
+            source_mysql->set_read_timeout_seconds(mooon::argument::sreadtimeout->value());
+            source_mysql->open();
             return true;
         }
         catch (mooon::sys::CDBException& ex)
@@ -345,7 +656,7 @@ bool CTableCopyer::init_source_mysql()
     return false;
 }
 
-bool CTableCopyer::init_destination_mysql()
+bool CTableCopyer::init_destination_mysql(mooon::sys::CMySQLConnection* destination_mysql)
 {
     for (int i=0; i<3; ++i)
     {
@@ -357,14 +668,14 @@ bool CTableCopyer::init_destination_mysql()
             }
             else
             {
-                _destination_mysql.set_host(mooon::argument::dhost->value(), mooon::argument::dport->value());
-                _destination_mysql.set_db_name(mooon::argument::dname->value());
-                _destination_mysql.set_user(mooon::argument::duser->value(), mooon::argument::dpassword->value());
-                _destination_mysql.enable_auto_reconnect(true);
-                _destination_mysql.set_connect_timeout_seconds(mooon::argument::dconntimeout->value());
-                _destination_mysql.set_write_timeout_seconds(mooon::argument::dwritetimeout->value());
-                _destination_mysql.set_read_timeout_seconds(mooon::argument::dreadtimeout->value());
-                _destination_mysql.open();
+                destination_mysql->set_host(mooon::argument::dhost->value(), mooon::argument::dport->value());
+                destination_mysql->set_db_name(mooon::argument::dname->value());
+                destination_mysql->set_user(mooon::argument::duser->value(), mooon::argument::dpassword->value());
+                destination_mysql->enable_auto_reconnect(true);
+                destination_mysql->set_connect_timeout_seconds(mooon::argument::dconntimeout->value());
+                destination_mysql->set_write_timeout_seconds(mooon::argument::dwritetimeout->value());
+                destination_mysql->set_read_timeout_seconds(mooon::argument::dreadtimeout->value());
+                destination_mysql->open();
                 return true;
             }
         }
@@ -384,9 +695,1038 @@ bool CTableCopyer::init_destination_mysql()
     return false;
 }
 
+void CTableCopyer::insert_values(const std::vector<std::string>& values, std::string* insertsql)
+{
+    const std::string values_str = mooon::utils::CStringUtils::container2string(values, ",");
+    const std::string ignore_str = mooon::argument::ignore->is_true()? " IGNORE ": " ";
+
+    if (mooon::argument::dfields->value().empty() || mooon::argument::dfields->value()=="*")
+    {
+        *insertsql = mooon::utils::CStringUtils::format_string(
+                "INSERT%sINTO %s VALUES %s", ignore_str.c_str(),
+                mooon::argument::dtable->c_value(), values_str.c_str());
+    }
+    else
+    {
+        *insertsql = mooon::utils::CStringUtils::format_string(
+                "INSERT%sINTO %s (%s) VALUES %s", ignore_str.c_str(),
+                mooon::argument::dtable->c_value(), mooon::argument::dfields->c_value(), values_str.c_str());
+    }
+
+    if (mooon::argument::test->is_true() ||
+        mooon::argument::verbose->is_true())
+    {
+        if (insertsql->size() < mooon::SIZE_32K)
+            fprintf(stdout, "[INSERTSQL] %s\n", insertsql->c_str());
+        else
+            fprintf(stdout, "[INSERTSQL] %.*s ... (%zu more than %d)\n",
+                    mooon::SIZE_32K, insertsql->c_str(), insertsql->size(), mooon::SIZE_32K);
+    }
+    if (mooon::argument::test->is_false())
+    {
+        _destination_mysql.update("%s", insertsql->c_str());
+    }
+}
+
 void CTableCopyer::print_cost(_IO_FILE* stdxxx, mooon::sys::CStopWatch& stopwatch)
 {
     const uint64_t microseconds = stopwatch.get_elapsed_microseconds();
     const double seconds = microseconds / (1000000.0);
     fprintf(stdxxx, "COST: %.3fs (%" PRIu64"us)\n", seconds, microseconds);
 }
+
+// 返回0成功，
+// 返回1出错，
+// 返回2表示没数据
+int CTableCopyer::copy_parallel()
+{
+    mooon::sys::CStopWatch stopwatch;
+    std::vector<CopyPartition> partitions;
+
+    mooon::sys::CSignalHandler::ignore_signal(SIGPIPE);
+    if (!load_checkpoint(&partitions))
+    {
+        const int exitcode = split_partitions(&partitions);
+        if (exitcode != 0)
+        {
+            print_cost(stderr, stopwatch);
+            fprintf(stderr, "%s\n", (2 == exitcode)? "NODATA": "FAILED");
+            return exitcode;
+        }
+        save_checkpoint(partitions);
+    }
+
+    // 已完成的分区不再复制
+    std::vector<CPartitionCopyer*> copyers(partitions.size(), static_cast<CPartitionCopyer*>(NULL));
+    bool started = true;
+    for (std::vector<CopyPartition>::size_type i=0; started && (i<partitions.size()); ++i)
+    {
+        if (partitions[i].done < partitions[i].hi)
+        {
+            copyers[i] = new CPartitionCopyer(partitions[i]);
+            started = copyers[i]->start();
+        }
+    }
+
+    // 定时保存进度，直到所有分区结束
+    bool failed = !started;
+    int seconds = 0;
+    for (bool finished=false; !finished;)
+    {
+        finished = true;
+        for (std::vector<CopyPartition>::size_type i=0; i<partitions.size(); ++i)
+        {
+            if (NULL == copyers[i])
+                continue;
+            copyers[i]->get_progress(&partitions[i]);
+            if (!copyers[i]->is_finished())
+                finished = false;
+            else if (copyers[i]->is_failed() && !failed)
+                failed = true;
+        }
+
+        // 一个分区出错时停止所有分区，已写入的进度仍然保存
+        if (failed)
+        {
+            for (std::vector<CPartitionCopyer*>::size_type i=0; i<copyers.size(); ++i)
+            {
+                if (copyers[i] != NULL)
+                    copyers[i]->stop();
+            }
+        }
+
+        save_checkpoint(partitions);
+        if (!finished)
+        {
+            mooon::sys::CUtils::millisleep(1000);
+            if ((mooon::argument::report->value() > 0) && (0 == ++seconds % mooon::argument::report->value()))
+                report_progress(partitions);
+        }
+    }
+
+    uint64_t num_rows = 0;
+    _IO_FILE* stdxxx = failed? stderr: stdout;
+    for (std::vector<CopyPartition>::size_type i=0; i<partitions.size(); ++i)
+    {
+        const CopyPartition& partition = partitions[i];
+        const double partition_seconds = partition.microseconds / 1000000.0;
+
+        num_rows += partition.rows;
+        fprintf(stdxxx, "PARTITION[%d]: [%" PRId64",%" PRId64"], ROW: %" PRIu64", COST: %.3fs, %.0f rows/s\n",
+                partition.index, partition.lo, partition.hi, partition.rows, partition_seconds,
+                (partition_seconds > 0)? partition.rows/partition_seconds: 0);
+        if ((copyers[i] != NULL) && copyers[i]->is_failed())
+            fprintf(stderr, "PARTITION[%d]: %s\n", partition.index, copyers[i]->get_error().c_str());
+        delete copyers[i];
+    }
+
+    print_cost(stdxxx, stopwatch);
+    fprintf(stdxxx, "ROW: %" PRIu64"\n", num_rows);
+    if (failed)
+    {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+
+    fprintf(stdout, "SUCCESS: %" PRId64" (The max value of --pkey)\n", partitions.back().hi);
+    return 0;
+}
+
+void CTableCopyer::report_progress(const std::vector<CopyPartition>& partitions)
+{
+    for (std::vector<CopyPartition>::size_type i=0; i<partitions.size(); ++i)
+    {
+        const CopyPartition& partition = partitions[i];
+        const double partition_seconds = partition.microseconds / 1000000.0;
+        fprintf(stdout, "[PROGRESS] PARTITION[%d]: %" PRId64"/%" PRId64", ROW: %" PRIu64", %.0f rows/s\n",
+                partition.index, partition.done, partition.hi, partition.rows,
+                (partition_seconds > 0)? partition.rows/partition_seconds: 0);
+    }
+}
+
+// 每个分区一个线程导出到一个文件，不使用进度文件，中断后须重新导出，
+// 返回0成功，
+// 返回1出错，
+// 返回2表示没数据
+int CTableCopyer::export_files()
+{
+    mooon::sys::CStopWatch stopwatch;
+    std::vector<CopyPartition> partitions;
+
+    if (mooon::argument::parallel->value() > 0)
+    {
+        const int exitcode = split_partitions(&partitions);
+        if (exitcode != 0)
+        {
+            print_cost(stderr, stopwatch);
+            fprintf(stderr, "%s\n", (2 == exitcode)? "NODATA": "FAILED");
+            return exitcode;
+        }
+    }
+    else
+    {
+        // 按--sql导出时没有主键区间，进度只有行数
+        CopyPartition partition;
+        partition.index = 0;
+        partition.lo = 0;
+        partition.hi = 0;
+        partition.done = 0;
+        partition.rows = 0;
+        partition.microseconds = 0;
+        partitions.push_back(partition);
+    }
+
+    const mooon::utils::compression_t compression = mooon::utils::get_compression_by_name(mooon::argument::compression->value());
+    std::vector<CPartitionExporter*> exporters;
+    bool failed = false;
+    for (std::vector<CopyPartition>::size_type i=0; !failed && (i<partitions.size()); ++i)
+    {
+        const std::string filepath = mooon::utils::CStringUtils::format_string("%s.%d.%s%s",
+                mooon::argument::dfile->c_value(), partitions[i].index, mooon::argument::format->c_value(),
+                mooon::utils::get_compression_suffix(compression));
+        exporters.push_back(new CPartitionExporter(partitions[i], filepath));
+        failed = !exporters.back()->start();
+    }
+
+    int seconds = 0;
+    for (bool finished=false; !finished;)
+    {
+        finished = true;
+        for (std::vector<CPartitionExporter*>::size_type i=0; i<exporters.size(); ++i)
+        {
+            exporters[i]->get_progress(&partitions[i]);
+            if (!exporters[i]->is_finished())
+                finished = false;
+            else if (exporters[i]->is_failed())
+                failed = true;
+        }
+        if (failed)
+        {
+            for (std::vector<CPartitionExporter*>::size_type i=0; i<exporters.size(); ++i)
+                exporters[i]->stop();
+        }
+
+        if (!finished)
+        {
+            mooon::sys::CUtils::millisleep(100);
+            if ((mooon::argument::report->value() > 0) && (0 == ++seconds % (mooon::argument::report->value()*10)))
+                report_progress(partitions);
+        }
+    }
+
+    uint64_t num_rows = 0;
+    _IO_FILE* stdxxx = failed? stderr: stdout;
+    for (std::vector<CPartitionExporter*>::size_type i=0; i<exporters.size(); ++i)
+    {
+        const CopyPartition& partition = partitions[i];
+        const double partition_seconds = partition.microseconds / 1000000.0;
+
+        num_rows += partition.rows;
+        fprintf(stdxxx, "PARTITION[%d]: [%" PRId64",%" PRId64"], ROW: %" PRIu64", COST: %.3fs, %.0f rows/s\n",
+                partition.index, partition.lo, partition.hi, partition.rows, partition_seconds,
+                (partition_seconds > 0)? partition.rows/partition_seconds: 0);
+        if (exporters[i]->is_failed())
+            fprintf(stderr, "PARTITION[%d]: %s\n", partition.index, exporters[i]->get_error().c_str());
+        delete exporters[i];
+    }
+
+    print_cost(stdxxx, stopwatch);
+    fprintf(stdxxx, "ROW: %" PRIu64"\n", num_rows);
+    if (failed)
+    {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+    if (0 == num_rows)
+    {
+        fprintf(stderr, "NODATA\n");
+        return 2;
+    }
+
+    fprintf(stdout, "SUCCESS: %zu files\n", partitions.size());
+    return 0;
+}
+
+// 返回0成功，
+// 返回1出错，
+// 返回2表示没有匹配的文件
+int CTableCopyer::load_files()
+{
+    mooon::sys::CStopWatch stopwatch;
+    std::vector<std::string> filepaths;
+    glob_t globbuf;
+
+    mooon::sys::CSignalHandler::ignore_signal(SIGPIPE);
+    const int errcode = glob(mooon::argument::sfile->c_value(), 0, NULL, &globbuf);
+    if (GLOB_NOMATCH == errcode)
+    {
+        fprintf(stderr, "NODATA\n");
+        return 2;
+    }
+    if (errcode != 0)
+    {
+        fprintf(stderr, "Glob %s failed: %d.\nFAILED\n", mooon::argument::sfile->c_value(), errcode);
+        return 1;
+    }
+    for (size_t i=0; i<globbuf.gl_pathc; ++i)
+        filepaths.push_back(globbuf.gl_pathv[i]);
+    globfree(&globbuf);
+
+    CFileLoader loader(filepaths);
+    const int thread_number = (mooon::argument::parallel->value() > 0)? mooon::argument::parallel->value(): 1;
+    const int failed_number = loader.load(thread_number);
+    _IO_FILE* stdxxx = (failed_number > 0)? stderr: stdout;
+
+    print_cost(stdxxx, stopwatch);
+    fprintf(stdxxx, "ROW: %" PRIu64"\n", loader.get_rows());
+    if (failed_number > 0)
+    {
+        fprintf(stderr, "FAILED: %d/%zu files\n", failed_number, filepaths.size());
+        return 1;
+    }
+
+    fprintf(stdout, "SUCCESS: %zu files\n", filepaths.size());
+    return 0;
+}
+
+// 返回0成功，
+// 返回1出错，
+// 返回2表示没数据
+int CTableCopyer::split_partitions(std::vector<CopyPartition>* partitions)
+{
+    if (!init_source_mysql(&_source_mysql))
+        return 1;
+
+    mooon::sys::DBRow db_row;
+    try
+    {
+        if (mooon::argument::swhere->value().empty())
+            _source_mysql.query(db_row, "SELECT MIN(%s),MAX(%s) FROM %s",
+                    mooon::argument::pkey->c_value(), mooon::argument::pkey->c_value(), mooon::argument::stable->c_value());
+        else
+            _source_mysql.query(db_row, "SELECT MIN(%s),MAX(%s) FROM %s WHERE %s",
+                    mooon::argument::pkey->c_value(), mooon::argument::pkey->c_value(), mooon::argument::stable->c_value(),
+                    mooon::argument::swhere->c_value());
+    }
+    catch (mooon::sys::CDBException& ex)
+    {
+        fprintf(stderr, "[SELECT_FROM_SOURCE] %s\n", ex.str().c_str());
+        return 1;
+    }
+
+    // 空表时MIN和MAX为NULL，被转成了空字符串
+    int64_t min_key, max_key;
+    if ((db_row.size() != 2) || db_row[0].empty())
+        return 2;
+    if (!mooon::utils::CStringUtils::string2int(db_row[0].c_str(), min_key)
+     || !mooon::utils::CStringUtils::string2int(db_row[1].c_str(), max_key))
+    {
+        fprintf(stderr, "Parameter[--pkey] is not an integer key: %s,%s.\n", db_row[0].c_str(), db_row[1].c_str());
+        return 1;
+    }
+
+    // 以主键的取值范围均分，主键不连续时各分区的行数可能不均匀
+    const uint64_t span = static_cast<uint64_t>(max_key - min_key) + 1;
+    uint64_t number = static_cast<uint64_t>(mooon::argument::parallel->value());
+    if (number > span)
+        number = span;
+    for (uint64_t i=0; i<number; ++i)
+    {
+        CopyPartition partition;
+        partition.index = static_cast<int>(i);
+        partition.lo = min_key + static_cast<int64_t>(span / number * i);
+        partition.hi = (i == number-1)? max_key: min_key + static_cast<int64_t>(span / number * (i+1)) - 1;
+        partition.done = partition.lo - 1;
+        partition.rows = 0;
+        partition.microseconds = 0;
+        partitions->push_back(partition);
+    }
+
+    return 0;
+}
+
+// 进度文件每行一个分区：序号 区间开始 区间结束 已写入的最大主键
+bool CTableCopyer::load_checkpoint(std::vector<CopyPartition>* partitions)
+{
+    if (mooon::argument::checkpoint->value().empty())
+        return false;
+
+    FILE* fp = fopen(mooon::argument::checkpoint->c_value(), "r");
+    if (NULL == fp)
+        return false;
+
+    CopyPartition partition;
+    partition.rows = 0;
+    partition.microseconds = 0;
+    while (4 == fscanf(fp, "%d %" SCNd64" %" SCNd64" %" SCNd64"\n", &partition.index, &partition.lo, &partition.hi, &partition.done))
+        partitions->push_back(partition);
+    fclose(fp);
+
+    if (partitions->empty())
+        return false;
+    fprintf(stdout, "Resume %zu partitions from %s\n", partitions->size(), mooon::argument::checkpoint->c_value());
+    return true;
+}
+
+void CTableCopyer::save_checkpoint(const std::vector<CopyPartition>& partitions)
+{
+    if (mooon::argument::checkpoint->value().empty())
+        return;
+
+    // 先写临时文件再改名，中途退出也不会留下不完整的进度文件
+    const std::string tmp_filepath = mooon::argument::checkpoint->value() + ".tmp";
+    FILE* fp = fopen(tmp_filepath.c_str(), "w");
+    if (NULL == fp)
+    {
+        fprintf(stderr, "Save checkpoint to %s failed: %s.\n", tmp_filepath.c_str(), strerror(errno));
+        return;
+    }
+
+    for (std::vector<CopyPartition>::size_type i=0; i<partitions.size(); ++i)
+    {
+        const CopyPartition& partition = partitions[i];
+        fprintf(fp, "%d %" PRId64" %" PRId64" %" PRId64"\n", partition.index, partition.lo, partition.hi, partition.done);
+    }
+    if ((fclose(fp) != 0) || (-1 == rename(tmp_filepath.c_str(), mooon::argument::checkpoint->c_value())))
+        fprintf(stderr, "Save checkpoint to %s failed: %s.\n", mooon::argument::checkpoint->c_value(), strerror(errno));
+}
+
+CPartitionCopyer::CPartitionCopyer(const CopyPartition& partition)
+    : _partition(partition), _reader(NULL), _writer(NULL), _finished(false), _failed(false)
+{
+}
+
+CPartitionCopyer::~CPartitionCopyer()
+{
+    stop();
+    if (_reader != NULL)
+    {
+        _reader->join();
+        delete _reader;
+    }
+    if (_writer != NULL)
+    {
+        _writer->join();
+        delete _writer;
+    }
+    for (std::deque<CopyPage*>::iterator iter=_pages.begin(); iter!=_pages.end(); ++iter)
+        delete *iter;
+}
+
+bool CPartitionCopyer::start()
+{
+    if (!CTableCopyer::init_source_mysql(&_source_mysql)
+     || !CTableCopyer::init_destination_mysql(&_destination_mysql))
+    {
+        _finished = true;
+        _failed = true;
+        _error = "connect failed";
+        return false;
+    }
+
+    _stopwatch.restart();
+    _writer = new mooon::sys::CThreadEngine(mooon::sys::bind(&CPartitionCopyer::write, this));
+    _reader = new mooon::sys::CThreadEngine(mooon::sys::bind(&CPartitionCopyer::read, this));
+    return true;
+}
+
+void CPartitionCopyer::stop()
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    if (!_failed && !_finished)
+    {
+        _failed = true;
+        if (_error.empty())
+            _error = "stopped";
+    }
+    _not_empty.broadcast();
+    _not_full.broadcast();
+}
+
+bool CPartitionCopyer::is_finished() const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    return _finished;
+}
+
+bool CPartitionCopyer::is_failed() const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    return _failed;
+}
+
+void CPartitionCopyer::get_progress(CopyPartition* partition) const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    *partition = _partition;
+}
+
+// 按主键分页，每页以上一页的最大主键为起点，不依赖OFFSET
+void CPartitionCopyer::read()
+{
+    const int page_size = (mooon::argument::batch->value() > 0)? mooon::argument::batch->value(): 10000;
+    const std::string fields = (mooon::argument::sfields->value() == "*")? mooon::argument::stable->value()+".*": mooon::argument::sfields->value();
+    const std::string condition = mooon::argument::swhere->value().empty()? std::string(): " AND ("+mooon::argument::swhere->value()+")";
+    int64_t last_key = _partition.done;
+
+    try
+    {
+        while (last_key < _partition.hi)
+        {
+            CopyPage* page = new CopyPage;
+            _source_mysql.query(page->rows, "SELECT %s,%s FROM %s WHERE %s>%" PRId64" AND %s<=%" PRId64"%s ORDER BY %s LIMIT %d",
+                    mooon::argument::pkey->c_value(), fields.c_str(), mooon::argument::stable->c_value(),
+                    mooon::argument::pkey->c_value(), last_key, mooon::argument::pkey->c_value(), _partition.hi,
+                    condition.c_str(), mooon::argument::pkey->c_value(), page_size);
+
+            // 不满一页说明区间已读完，进度直接推进到区间结束
+            if (static_cast<int>(page->rows.size()) < page_size)
+                page->last_key = _partition.hi;
+            else if (!mooon::utils::CStringUtils::string2int(page->rows.back()[0].c_str(), page->last_key))
+                THROW_DB_EXCEPTION(NULL, "invalid primary key: "+page->rows.back()[0], -1);
+
+            last_key = page->last_key;
+            if (!push(page))
+                return;
+        }
+    }
+    catch (mooon::sys::CDBException& ex)
+    {
+        fail("SELECT_FROM_SOURCE", ex);
+    }
+
+    push(NULL);
+}
+
+void CPartitionCopyer::write()
+{
+    mooon::utils::ScopedPtr<mooon::sys::CDBBatchInserter> inserter;
+    uint64_t rows = 0;
+
+    try
+    {
+        if (mooon::argument::test->is_false())
+        {
+            const std::string dfields = (mooon::argument::dfields->value() == "*")? std::string(): mooon::argument::dfields->value();
+            inserter.reset(new mooon::sys::CDBBatchInserter(&_destination_mysql, mooon::argument::dtable->value(), dfields));
+            inserter->set_ignore(mooon::argument::ignore->is_true());
+            inserter->set_max_rows((mooon::argument::batch->value() > 0)? mooon::argument::batch->value(): 10000);
+            inserter->set_max_bytes_by_server();
+        }
+
+        for (;;)
+        {
+            mooon::utils::ScopedPtr<CopyPage> page(pop());
+            if (NULL == page.get())
+                break;
+
+            if (inserter.get() != NULL)
+            {
+                for (mooon::sys::DBTable::size_type i=0; i<page->rows.size(); ++i)
+                {
+                    const mooon::sys::DBRow& row = page->rows[i];
+                    inserter->add_row(mooon::sys::DBRow(row.begin()+1, row.end()));
+                }
+                inserter->flush();
+            }
+
+            // 一页写完才推进进度，重新运行时最多重复写入一页
+            rows += page->rows.size();
+            mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+            _partition.done = page->last_key;
+            _partition.rows = rows;
+            _partition.microseconds = _stopwatch.get_elapsed_microseconds(false);
+        }
+    }
+    catch (mooon::sys::CDBException& ex)
+    {
+        fail("INSERT_INTO_DESTINATION", ex);
+    }
+
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    _partition.microseconds = _stopwatch.get_elapsed_microseconds(false);
+    _finished = true;
+    _not_full.broadcast(); // 唤醒可能阻塞在push中的读线程
+}
+
+// 积压满时等待，出错或被停止时返回false
+bool CPartitionCopyer::push(CopyPage* page)
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    while ((static_cast<int>(_pages.size()) >= mooon::argument::queue->value()) && !_failed && !_finished)
+        _not_full.wait(_lock);
+    if (_failed || _finished)
+    {
+        delete page;
+        return false;
+    }
+
+    _pages.push_back(page);
+    _not_empty.signal();
+    return true;
+}
+
+// 出错或被停止时返回NULL
+CPartitionCopyer::CopyPage* CPartitionCopyer::pop()
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    while (_pages.empty() && !_failed)
+        _not_empty.wait(_lock);
+    if (_failed)
+        return NULL;
+
+    CopyPage* page = _pages.front();
+    _pages.pop_front();
+    _not_full.signal();
+    return page;
+}
+
+void CPartitionCopyer::fail(const std::string& tag, mooon::sys::CDBException& ex)
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    if (!_failed)
+    {
+        _failed = true;
+        _error = "[" + tag + "] " + ex.str();
+    }
+    _not_empty.broadcast();
+    _not_full.broadcast();
+}
+
+CExportFile::CExportFile()
+    : _fd(-1)
+{
+}
+
+CExportFile::~CExportFile()
+{
+    if (_fd != -1)
+        ::close(_fd);
+}
+
+bool CExportFile::open(const std::string& filepath, mooon::utils::compression_t compression)
+{
+    _filepath = filepath;
+    _fd = ::open(filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM);
+    if (-1 == _fd)
+    {
+        _error = mooon::utils::CStringUtils::format_string("open %s failed: %s", filepath.c_str(), strerror(errno));
+        return false;
+    }
+
+    try
+    {
+        if (compression != mooon::utils::compression_none)
+            _compressor.reset(new mooon::utils::CCompressor(compression));
+        return true;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        _error = ex.str();
+        return false;
+    }
+}
+
+bool CExportFile::write(const std::string& data)
+{
+    if (NULL == _compressor.get())
+        return write_file(data);
+
+    try
+    {
+        _compressed.clear();
+        _compressor->compress(data.data(), data.size(), &_compressed);
+        return write_file(_compressed);
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        _error = ex.str();
+        return false;
+    }
+}
+
+bool CExportFile::close()
+{
+    if (_compressor.get() != NULL)
+    {
+        try
+        {
+            _compressed.clear();
+            _compressor->finish(&_compressed);
+        }
+        catch (mooon::utils::CException& ex)
+        {
+            _error = ex.str();
+            return false;
+        }
+        if (!write_file(_compressed))
+            return false;
+    }
+
+    const int fd = _fd;
+    _fd = -1;
+    if (::close(fd) != 0)
+    {
+        _error = mooon::utils::CStringUtils::format_string("close %s failed: %s", _filepath.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool CExportFile::write_file(const std::string& data)
+{
+    for (std::string::size_type offset=0; offset<data.size();)
+    {
+        const ssize_t bytes = ::write(_fd, data.data()+offset, data.size()-offset);
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            _error = mooon::utils::CStringUtils::format_string("write %s failed: %s", _filepath.c_str(), strerror(errno));
+            return false;
+        }
+        offset += static_cast<std::string::size_type>(bytes);
+    }
+    return true;
+}
+
+CPartitionExporter::CPartitionExporter(const CopyPartition& partition, const std::string& filepath)
+    : _partition(partition), _filepath(filepath), _thread(NULL), _finished(false), _failed(false)
+{
+}
+
+CPartitionExporter::~CPartitionExporter()
+{
+    stop();
+    if (_thread != NULL)
+    {
+        _thread->join();
+        delete _thread;
+    }
+}
+
+bool CPartitionExporter::start()
+{
+    if (!CTableCopyer::init_source_mysql(&_source_mysql))
+    {
+        _finished = true;
+        _failed = true;
+        _error = "connect failed";
+        return false;
+    }
+
+    _stopwatch.restart();
+    _thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&CPartitionExporter::run, this));
+    return true;
+}
+
+void CPartitionExporter::stop()
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    if (!_failed && !_finished)
+    {
+        _failed = true;
+        _error = "stopped";
+    }
+}
+
+bool CPartitionExporter::is_finished() const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    return _finished;
+}
+
+bool CPartitionExporter::is_failed() const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    return _failed;
+}
+
+void CPartitionExporter::get_progress(CopyPartition* partition) const
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    *partition = _partition;
+}
+
+// 以游标读整个分区，不分页，按区间导出时第一列为主键，不写入文件
+void CPartitionExporter::run()
+{
+    const bool csv = (mooon::argument::format->value() == "csv");
+    const bool by_pkey = (mooon::argument::parallel->value() > 0);
+    const size_t buffer_size = mooon::SIZE_1M;
+    CExportFile file;
+    std::string querysql;
+    std::string buffer;
+    uint64_t rows = 0;
+
+    if (by_pkey)
+    {
+        const std::string fields = (mooon::argument::sfields->value() == "*")? mooon::argument::stable->value()+".*": mooon::argument::sfields->value();
+        const std::string condition = mooon::argument::swhere->value().empty()? std::string(): " AND ("+mooon::argument::swhere->value()+")";
+        querysql = mooon::utils::CStringUtils::format_string("SELECT %s,%s FROM %s WHERE %s>=%" PRId64" AND %s<=%" PRId64"%s",
+                mooon::argument::pkey->c_value(), fields.c_str(), mooon::argument::stable->c_value(),
+                mooon::argument::pkey->c_value(), _partition.lo, mooon::argument::pkey->c_value(), _partition.hi,
+                condition.c_str());
+    }
+    else
+    {
+        querysql = mooon::argument::sql->value();
+    }
+    if (mooon::argument::verbose->is_true())
+        fprintf(stdout, "[SELECTSQL] %s\n", querysql.c_str());
+
+    if (!file.open(_filepath, mooon::utils::get_compression_by_name(mooon::argument::compression->value())))
+    {
+        fail(file.get_error());
+        return;
+    }
+    try
+    {
+        mooon::utils::ScopedPtr<mooon::sys::DBCursor> cursor(_source_mysql.open_cursor("%s", querysql.c_str()));
+        const int first_col = by_pkey? 1: 0;
+        int64_t key = _partition.done;
+
+        buffer.reserve(buffer_size + mooon::SIZE_4K);
+        while (cursor->fetch())
+        {
+            for (int col=first_col; col<cursor->get_field_number(); ++col)
+            {
+                if (col > first_col)
+                    buffer.push_back(csv? ',': '\t');
+                append_field(csv, cursor->get_field(col), &buffer);
+            }
+            buffer.push_back('\n');
+            ++rows;
+
+            if (buffer.size() >= buffer_size)
+            {
+                if (by_pkey)
+                {
+                    const mooon::sys::DBField& field = cursor->get_field(0);
+                    if (!mooon::utils::CStringUtils::string2int(std::string(field.data, field.size).c_str(), key))
+                        THROW_DB_EXCEPTION(NULL, "invalid primary key: "+std::string(field.data, field.size), -1);
+                }
+                if (!file.write(buffer))
+                {
+                    fail(file.get_error());
+                    return;
+                }
+                buffer.clear();
+
+                mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+                if (_failed)
+                {
+                    _finished = true; // 被停止
+                    return;
+                }
+                _partition.done = key;
+                _partition.rows = rows;
+                _partition.microseconds = _stopwatch.get_elapsed_microseconds(false);
+            }
+        }
+    }
+    catch (mooon::sys::CDBException& ex)
+    {
+        fail("[SELECT_FROM_SOURCE] " + ex.str());
+        return;
+    }
+
+    if (!file.write(buffer) || !file.close())
+    {
+        fail(file.get_error());
+        return;
+    }
+
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    _partition.done = _partition.hi;
+    _partition.rows = rows;
+    _partition.microseconds = _stopwatch.get_elapsed_microseconds(false);
+    _finished = true;
+}
+
+void CPartitionExporter::fail(const std::string& error)
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    if (!_failed)
+    {
+        _failed = true;
+        _error = error;
+    }
+    _partition.microseconds = _stopwatch.get_elapsed_microseconds(false);
+    _finished = true;
+}
+
+CInfileReader::CInfileReader(const std::string& filepath)
+    : _filepath(filepath), _fd(-1), _eof(false), _detected(false), _offset(0)
+{
+}
+
+CInfileReader::~CInfileReader()
+{
+    if (_fd != -1)
+        ::close(_fd);
+}
+
+bool CInfileReader::open()
+{
+    _fd = ::open(_filepath.c_str(), O_RDONLY);
+    if (-1 == _fd)
+    {
+        _error = mooon::utils::CStringUtils::format_string("open %s failed: %s", _filepath.c_str(), strerror(errno));
+        return false;
+    }
+
+    (void)posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+// 在客户端库的回调中调用，不能抛出异常
+int CInfileReader::read(char* buffer, unsigned int size)
+{
+    while (_offset >= _output.size())
+    {
+        if (_eof)
+            return 0;
+        if (!fill())
+            return -1;
+    }
+
+    const std::string::size_type bytes = std::min<std::string::size_type>(size, _output.size()-_offset);
+    memcpy(buffer, _output.data()+_offset, bytes);
+    _offset += bytes;
+    return static_cast<int>(bytes);
+}
+
+// 读一块文件，第一块时由魔数识别压缩方式
+bool CInfileReader::fill()
+{
+    _input.resize(mooon::SIZE_1M);
+    ssize_t bytes;
+    do
+    {
+        bytes = ::read(_fd, const_cast<char*>(_input.data()), _input.size());
+    } while ((-1 == bytes) && (EINTR == errno));
+    if (-1 == bytes)
+    {
+        _error = mooon::utils::CStringUtils::format_string("read %s failed: %s", _filepath.c_str(), strerror(errno));
+        return false;
+    }
+
+    _input.resize(static_cast<std::string::size_type>(bytes));
+    _output.clear();
+    _offset = 0;
+    if (0 == bytes)
+        _eof = true;
+
+    try
+    {
+        if (!_detected)
+        {
+            const mooon::utils::compression_t compression = mooon::utils::detect_compression(_input.data(), _input.size());
+            if (compression != mooon::utils::compression_none)
+                _decompressor.reset(new mooon::utils::CDecompressor(compression));
+            _detected = true;
+        }
+        if (NULL == _decompressor.get())
+        {
+            _output.swap(_input);
+        }
+        else if (!_input.empty())
+        {
+            _decompressor->decompress(_input.data(), _input.size(), &_output);
+        }
+        return true;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        _error = _filepath + ": " + ex.str();
+        return false;
+    }
+}
+
+CFileLoader::CFileLoader(const std::vector<std::string>& filepaths)
+    : _filepaths(filepaths), _index(0), _rows(0), _failed_number(0)
+{
+}
+
+CFileLoader::~CFileLoader()
+{
+}
+
+int CFileLoader::load(int thread_number)
+{
+    std::vector<mooon::sys::CThreadEngine*> threads;
+    if (static_cast<size_t>(thread_number) > _filepaths.size())
+        thread_number = static_cast<int>(_filepaths.size());
+    for (int i=0; i<thread_number; ++i)
+        threads.push_back(new mooon::sys::CThreadEngine(mooon::sys::bind(&CFileLoader::run, this)));
+    for (std::vector<mooon::sys::CThreadEngine*>::size_type i=0; i<threads.size(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    return _failed_number;
+}
+
+// 每个线程一个目标库连接，每个文件一条LOAD DATA语句
+void CFileLoader::run()
+{
+    const bool csv = (mooon::argument::format->value() == "csv");
+    const std::string ignore_str = mooon::argument::ignore->is_true()? " IGNORE ": " ";
+    const std::string dfields = (mooon::argument::dfields->value() == "*")? std::string(): " ("+mooon::argument::dfields->value()+")";
+    const char* format_str = csv? " FIELDS TERMINATED BY ',' OPTIONALLY ENCLOSED BY '\"' ESCAPED BY ''": "";
+    mooon::sys::CMySQLConnection destination_mysql;
+    std::string filepath;
+
+    destination_mysql.enable_local_infile(true);
+    if (!CTableCopyer::init_destination_mysql(&destination_mysql))
+    {
+        mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+        _failed_number += static_cast<int>(_filepaths.size() - _index);
+        _index = _filepaths.size();
+        return;
+    }
+
+    while (next(&filepath))
+    {
+        // 文件名只用于出错信息，内容由CInfileReader提供
+        const std::string loadsql = mooon::utils::CStringUtils::format_string(
+                "LOAD DATA LOCAL INFILE '%s'%sINTO TABLE %s%s%s",
+                destination_mysql.escape_string(filepath).c_str(), ignore_str.c_str(),
+                mooon::argument::dtable->c_value(), format_str, dfields.c_str());
+        mooon::sys::CStopWatch stopwatch;
+        uint64_t rows = 0;
+
+        if (mooon::argument::test->is_true() || mooon::argument::verbose->is_true())
+            fprintf(stdout, "[LOADSQL] %s\n", loadsql.c_str());
+        try
+        {
+            CInfileReader reader(filepath);
+            if (!reader.open())
+                THROW_DB_EXCEPTION(loadsql.c_str(), reader.get_error(), -1);
+            if (mooon::argument::test->is_false())
+                rows = destination_mysql.load_data_local(loadsql, &reader);
+
+            const double seconds = stopwatch.get_elapsed_microseconds() / 1000000.0;
+            mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+            _rows += rows;
+            fprintf(stdout, "FILE: %s, ROW: %" PRIu64", COST: %.3fs, %.0f rows/s\n",
+                    filepath.c_str(), rows, seconds, (seconds > 0)? rows/seconds: 0);
+        }
+        catch (mooon::sys::CDBException& ex)
+        {
+            mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+            ++_failed_number;
+            fprintf(stderr, "[LOAD_INTO_DESTINATION] %s: %s\n", filepath.c_str(), ex.str().c_str());
+        }
+    }
+}
+
+bool CFileLoader::next(std::string* filepath)
+{
+    mooon::sys::LockHelper<mooon::sys::CLock> lock_helper(_lock);
+    if (_index >= _filepaths.size())
+        return false;
+    *filepath = _filepaths[_index++];
+    return true;
+}
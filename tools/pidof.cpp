@@ -1,6 +1,8 @@
 // Writed by yijian on 2018/10/19
 // get all pid by process name
+#include <mooon/sys/process_table.h>
 #include <mooon/sys/utils.h>
+#include <mooon/utils/exception.h>
 
 // argv[1] process name
 // argv[2] regex
@@ -29,9 +31,20 @@ int main(int argc, char* argv[])
         }
     }
 
-    std::vector<int64_t> pid_array;
-    const int n = mooon::sys::CUtils::get_all_pid(process_name, &pid_array, regex);
-    for (int i=0; i<n; ++i)
-        fprintf(stdout, "%" PRId64"\n", pid_array[i]);
-    return 0;
+    try
+    {
+        // 进程多时自动并行扫描，只有名字符合的进程才被完整解析
+        mooon::sys::CProcessNameFilter filter(process_name, regex);
+        mooon::sys::CProcessTable process_table;
+
+        process_table.scan(mooon::sys::CProcessTable::PROCESS_STAT, 0, &filter);
+        for (size_t i=0; i<process_table.get_process_number(); ++i)
+            fprintf(stdout, "%" PRId64"\n", process_table.get_process(i).pid);
+        return 0;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
 }
@@ -20,13 +20,28 @@
 //
 // 运行示例：
 // r3c_stress --redis=192.168.0.88:6379 --requests=100000 --threads=20
+//
+// 指定--mix时运行混合负载，而不是依次测试各命令，按命令分别输出延迟的百分位数：
+// 闭环，80%的GET和20%的SET，键按zipfian分布：
+//   r3c_stress --redis=192.168.0.88:6379 --mix=get:80,set:20 --distribution=zipfian --requests=100000 --threads=20
+// 开环，所有线程共每秒50000个请求，流水线深度16，10%的键承担90%的请求：
+//   r3c_stress --redis=192.168.0.88:6379 --mix=get:70,hset:20,lpush:10 --rate=50000 --pipeline=16 --distribution=hotspot
+//
+// 开环时请求按固定的间隔排定，延迟从排定的时间而不是实际发出的时间算起，
+// 因此服务端变慢导致的排队计入延迟，不会因少发请求而被掩盖（coordinated omission）。
 #include <r3c/r3c.h>
+#include <hiredis/hiredis.h>
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/metrics.h>
 #include <mooon/sys/stop_watch.h>
 #include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
+#include <mooon/utils/hash_utils.h>
 #include <mooon/utils/string_utils.h>
+#include <mooon/utils/tokener.h>
+#include <math.h>
 
 // 运行模式，如果是清理，需要保持参数和测试时相同
 INTEGER_ARG_DEFINE(uint8_t, test, 1, 0, 1, "1: test, 0: clean test data");
@@ -40,6 +55,16 @@ INTEGER_ARG_DEFINE(uint8_t, verbose, 0, 0, 1, "print error");
 INTEGER_ARG_DEFINE(uint8_t, increments, 10, 1, 100, "number of increments for hmincrby");
 INTEGER_ARG_DEFINE(uint16_t, value_length, 10, 1, std::numeric_limits<uint16_t>::max(), "length of value");
 
+// 混合负载
+STRING_ARG_DEFINE(mix, "", "mixed workload of command:ratio, e.g., --mix=get:80,set:20, commands: get,set,setnx,setex,hget,hset,lpush,rpop");
+INTEGER_ARG_DEFINE(uint32_t, rate, 0, 0, 100000000, "target requests per second of all threads in open loop, 0 for closed loop");
+INTEGER_ARG_DEFINE(uint16_t, pipeline, 1, 1, 10000, "pipeline depth, more than 1 sends by hiredis to the first node of --redis");
+INTEGER_ARG_DEFINE(uint32_t, keys, 100000, 1, std::numeric_limits<int32_t>::max(), "number of keys of mixed workload");
+STRING_ARG_DEFINE(distribution, "uniform", "key distribution: uniform, zipfian or hotspot");
+DOUBLE_ARG_DEFINE(zipf_theta, 0.99, 0.01, 0.999, "theta of zipfian distribution");
+INTEGER_ARG_DEFINE(uint8_t, hot_keys, 10, 1, 99, "percent of keys are hot for hotspot distribution");
+INTEGER_ARG_DEFINE(uint8_t, hot_requests, 90, 1, 100, "percent of requests access hot keys for hotspot distribution");
+
 static atomic_t sg_success = 0;
 static atomic_t sg_failure = 0;
 static atomic_t sg_not_exists = 0;
@@ -69,6 +94,10 @@ static void hmincrby_stress_thread(uint8_t index);
 static void lpush_stress_thread(uint8_t index);
 static void rpop_stress_thread(uint8_t index);
 
+static void mix_test();
+static void mix_stress_thread(uint8_t index);
+static void mix_clean_thread(uint8_t index);
+
 int main(int argc, char* argv[])
 {
     std::string errmsg;
@@ -83,6 +112,12 @@ int main(int argc, char* argv[])
 
     try
     {
+        if (!mooon::argument::mix->value().empty())
+        {
+            mix_test();
+            return 0;
+        }
+
         // KV
         set_test();
         if (is_test_mode())
@@ -807,3 +842,405 @@ void rpop_stress_thread(uint8_t index)
         fprintf(stderr, "[%s] %s\n", __FUNCTION__, ex.str().c_str());
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////
+enum
+{
+    CMD_GET, CMD_SET, CMD_SETNX, CMD_SETEX, CMD_HGET, CMD_HSET, CMD_LPUSH, CMD_RPOP,
+    CMD_MAX
+};
+static const char* sg_command_names[CMD_MAX] = { "get", "set", "setnx", "setex", "hget", "hset", "lpush", "rpop" };
+static int sg_command_ratios[CMD_MAX] = { 0 };
+static int sg_ratio_sum = 0;
+static double sg_zipf_zetan = 0; // zeta(keys, theta)
+static double sg_zipf_eta = 0;
+static double sg_zipf_alpha = 0;
+static mooon::sys::CLatencyHistogram sg_histograms[CMD_MAX];
+static atomic_t sg_command_failures[CMD_MAX];
+
+// 一个待发或已发的请求
+struct Request
+{
+    int command;
+    uint32_t key_index;
+    uint64_t intended_ns; // 开环时为排定的时间，闭环时为发出的时间
+};
+
+static bool parse_mix(std::string* errmsg)
+{
+    std::vector<std::string> items;
+    mooon::utils::CTokener::split(&items, mooon::argument::mix->value(), ",", true);
+    for (std::vector<std::string>::size_type i=0; i<items.size(); ++i)
+    {
+        std::vector<std::string> pair;
+        int command = 0;
+        int ratio = 0;
+        mooon::utils::CTokener::split(&pair, items[i], ":");
+        while ((command < CMD_MAX) && (pair[0] != sg_command_names[command]))
+            ++command;
+        if ((command == CMD_MAX) || (pair.size() != 2) || !mooon::utils::CStringUtils::string2int(pair[1].c_str(), ratio) || (ratio < 0))
+        {
+            *errmsg = "invalid --mix item: " + items[i];
+            return false;
+        }
+        sg_command_ratios[command] += ratio;
+        sg_ratio_sum += ratio;
+    }
+    if (0 == sg_ratio_sum)
+    {
+        *errmsg = "sum of ratios of --mix is 0";
+        return false;
+    }
+
+    const std::string& distribution = mooon::argument::distribution->value();
+    if (("uniform" != distribution) && ("zipfian" != distribution) && ("hotspot" != distribution))
+    {
+        *errmsg = "unknown --distribution: " + distribution;
+        return false;
+    }
+    return true;
+}
+
+// Gray等的zipfian生成算法（同YCSB），预先计算zeta(n, theta)，之后每次O(1)
+static void init_zipfian()
+{
+    const double theta = mooon::argument::zipf_theta->value();
+    const uint32_t n = mooon::argument::keys->value();
+    double zeta2 = 0;
+    for (uint32_t i=1; i<=n; ++i)
+    {
+        sg_zipf_zetan += 1.0 / pow(static_cast<double>(i), theta);
+        if (2 == i)
+            zeta2 = sg_zipf_zetan;
+    }
+    if (n < 2)
+        zeta2 = sg_zipf_zetan;
+    sg_zipf_alpha = 1.0 / (1.0 - theta);
+    sg_zipf_eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / sg_zipf_zetan);
+}
+
+// xorshift64*
+static uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+// 得到[0, 1)间的均匀随机数
+static double next_double(uint64_t* state)
+{
+    return static_cast<double>(next_random(state) >> 11) / static_cast<double>(1ULL << 53);
+}
+
+static uint32_t next_key_index(uint64_t* state)
+{
+    const uint32_t n = mooon::argument::keys->value();
+    const std::string& distribution = mooon::argument::distribution->value();
+
+    if ("zipfian" == distribution)
+    {
+        // 排名靠前的最热，再打散，以免热键集中在相邻的键上
+        const double theta = mooon::argument::zipf_theta->value();
+        const double u = next_double(state);
+        const double uz = u * sg_zipf_zetan;
+        uint64_t rank;
+        if (uz < 1.0)
+            rank = 0;
+        else if (uz < 1.0 + pow(0.5, theta))
+            rank = 1;
+        else
+            rank = static_cast<uint64_t>(n * pow(sg_zipf_eta * u - sg_zipf_eta + 1.0, sg_zipf_alpha));
+        if (rank >= n)
+            rank = n - 1;
+        return static_cast<uint32_t>(mooon::utils::CHashUtils::mix64(rank) % n);
+    }
+    if ("hotspot" == distribution)
+    {
+        const uint32_t hot_number = std::max<uint32_t>(1, static_cast<uint32_t>(static_cast<uint64_t>(n) * mooon::argument::hot_keys->value() / 100));
+        if ((next_random(state) % 100 < mooon::argument::hot_requests->value()) || (hot_number >= n))
+            return static_cast<uint32_t>(next_random(state) % hot_number);
+        return hot_number + static_cast<uint32_t>(next_random(state) % (n - hot_number));
+    }
+    return static_cast<uint32_t>(next_random(state) % n);
+}
+
+static int next_command(uint64_t* state)
+{
+    int r = static_cast<int>(next_random(state) % sg_ratio_sum);
+    for (int command=0; command<CMD_MAX; ++command)
+    {
+        if (r < sg_command_ratios[command])
+            return command;
+        r -= sg_command_ratios[command];
+    }
+    return CMD_GET;
+}
+
+static std::string get_mix_key(int command, uint32_t key_index)
+{
+    const char* type = ((CMD_HGET == command) || (CMD_HSET == command))? "h": ((CMD_LPUSH == command) || (CMD_RPOP == command))? "l": "kv";
+    return mooon::utils::CStringUtils::format_string("%s_mix_%s_%u", mooon::argument::prefix->c_value(), type, key_index);
+}
+
+// 以r3c执行一个请求，不存在不算失败
+static void execute_by_r3c(r3c::CRedisClient* redis, const Request& request, const std::string& value)
+{
+    const std::string& key = get_mix_key(request.command, request.key_index);
+    std::string result;
+
+    switch (request.command)
+    {
+    case CMD_GET:   (void)redis->get(key, &result); break;
+    case CMD_SET:   redis->set(key, value); break;
+    case CMD_SETNX: (void)redis->setnx(key, value); break;
+    case CMD_SETEX: redis->setex(key, value, mooon::argument::expire->value()); break;
+    case CMD_HGET:  (void)redis->hget(key, "f", &result); break;
+    case CMD_HSET:  (void)redis->hset(key, "f", value); break;
+    case CMD_LPUSH: (void)redis->lpush(key, value); break;
+    default:        (void)redis->rpop(key, &result); break;
+    }
+}
+
+static void append_by_hiredis(redisContext* context, const Request& request, const std::string& value)
+{
+    const std::string& key = get_mix_key(request.command, request.key_index);
+
+    switch (request.command)
+    {
+    case CMD_GET:   redisAppendCommand(context, "GET %b", key.data(), key.size()); break;
+    case CMD_SET:   redisAppendCommand(context, "SET %b %b", key.data(), key.size(), value.data(), value.size()); break;
+    case CMD_SETNX: redisAppendCommand(context, "SETNX %b %b", key.data(), key.size(), value.data(), value.size()); break;
+    case CMD_SETEX: redisAppendCommand(context, "SETEX %b %u %b", key.data(), key.size(), mooon::argument::expire->value(), value.data(), value.size()); break;
+    case CMD_HGET:  redisAppendCommand(context, "HGET %b f", key.data(), key.size()); break;
+    case CMD_HSET:  redisAppendCommand(context, "HSET %b f %b", key.data(), key.size(), value.data(), value.size()); break;
+    case CMD_LPUSH: redisAppendCommand(context, "LPUSH %b %b", key.data(), key.size(), value.data(), value.size()); break;
+    default:        redisAppendCommand(context, "RPOP %b", key.data(), key.size()); break;
+    }
+}
+
+static redisContext* connect_first_node()
+{
+    std::vector<std::string> nodes;
+    std::vector<std::string> ip_port;
+    mooon::utils::CTokener::split(&nodes, mooon::argument::redis->value(), ",", true);
+    mooon::utils::CTokener::split(&ip_port, nodes.empty()? std::string(): nodes[0], ":");
+
+    const uint16_t port = (ip_port.size() > 1)? mooon::utils::CStringUtils::string2int<uint16_t>(ip_port[1]): 6379;
+    struct timeval timeout = { 10, 0 };
+    redisContext* context = redisConnectWithTimeout(ip_port.empty()? "127.0.0.1": ip_port[0].c_str(), port, timeout);
+    if ((NULL == context) || (context->err != 0))
+    {
+        fprintf(stderr, "connect %s error: %s\n", mooon::argument::redis->c_value(), (NULL == context)? "out of memory": context->errstr);
+        if (context != NULL)
+            redisFree(context);
+        return NULL;
+    }
+    return context;
+}
+
+static void record(const Request& request, uint64_t end_ns, bool ok)
+{
+    sg_histograms[request.command].record(end_ns - request.intended_ns);
+    if (ok)
+    {
+        atomic_inc(&sg_success);
+    }
+    else
+    {
+        atomic_inc(&sg_failure);
+        atomic_inc(&sg_command_failures[request.command]);
+    }
+}
+
+void mix_stress_thread(uint8_t index)
+{
+    const std::string value(mooon::argument::value_length->value(), '*');
+    const uint16_t depth = mooon::argument::pipeline->value();
+    const uint64_t interval_ns = (0 == mooon::argument::rate->value())? 0: 1000000000ULL * mooon::argument::threads->value() / mooon::argument::rate->value();
+    uint64_t random_state = 0x9E3779B97F4A7C15ULL * (index + 1);
+    std::vector<Request> requests;
+    redisContext* context = NULL;
+
+    try
+    {
+        r3c::CRedisClient redis(mooon::argument::redis->value());
+        if (depth > 1)
+        {
+            context = connect_first_node();
+            if (NULL == context)
+                return;
+        }
+
+        // 各线程错开排定的时间，避免同时发出
+        uint64_t next_intended_ns = mooon::sys::CClock::get_nanoseconds() + interval_ns * index / mooon::argument::threads->value();
+        for (uint32_t i=0; i<mooon::argument::requests->value();)
+        {
+            // 开环时等到下一个排定的时间，之后已到时间的（最多depth个）一起发出
+            requests.clear();
+            uint64_t now_ns = mooon::sys::CClock::get_nanoseconds();
+            if ((interval_ns > 0) && (now_ns < next_intended_ns))
+            {
+                const uint64_t sleep_ns = next_intended_ns - now_ns;
+                if (sleep_ns > 100000)
+                    mooon::sys::CUtils::microsleep(static_cast<uint32_t>((sleep_ns - 50000) / 1000));
+                while ((now_ns = mooon::sys::CClock::get_nanoseconds()) < next_intended_ns)
+                    ;
+            }
+            while ((requests.size() < depth) && (i < mooon::argument::requests->value()))
+            {
+                Request request;
+                request.command = next_command(&random_state);
+                request.key_index = next_key_index(&random_state);
+                if (interval_ns > 0)
+                {
+                    if (next_intended_ns > now_ns)
+                        break;
+                    request.intended_ns = next_intended_ns;
+                    next_intended_ns += interval_ns;
+                }
+                else
+                {
+                    request.intended_ns = now_ns;
+                }
+                requests.push_back(request);
+                ++i;
+            }
+
+            if (NULL == context)
+            {
+                // r3c不支持流水线，每次一个
+                for (std::vector<Request>::size_type j=0; j<requests.size(); ++j)
+                {
+                    bool ok = true;
+                    if (0 == interval_ns)
+                        requests[j].intended_ns = mooon::sys::CClock::get_nanoseconds();
+                    try
+                    {
+                        execute_by_r3c(&redis, requests[j], value);
+                    }
+                    catch (r3c::CRedisException& ex)
+                    {
+                        ok = false;
+                        if (1 == mooon::argument::verbose->value())
+                            fprintf(stderr, "%s ERROR: %s\n", sg_command_names[requests[j].command], ex.str().c_str());
+                    }
+                    record(requests[j], mooon::sys::CClock::get_nanoseconds(), ok);
+                }
+            }
+            else
+            {
+                for (std::vector<Request>::size_type j=0; j<requests.size(); ++j)
+                    append_by_hiredis(context, requests[j], value);
+                for (std::vector<Request>::size_type j=0; j<requests.size(); ++j)
+                {
+                    void* reply = NULL;
+                    if (REDIS_OK != redisGetReply(context, &reply))
+                    {
+                        fprintf(stderr, "[%s] %s\n", __FUNCTION__, context->errstr);
+                        redisFree(context);
+                        return;
+                    }
+
+                    const bool ok = static_cast<redisReply*>(reply)->type != REDIS_REPLY_ERROR;
+                    if (!ok && (1 == mooon::argument::verbose->value()))
+                        fprintf(stderr, "%s ERROR: %s\n", sg_command_names[requests[j].command], static_cast<redisReply*>(reply)->str);
+                    freeReplyObject(reply);
+                    record(requests[j], mooon::sys::CClock::get_nanoseconds(), ok);
+                }
+            }
+        }
+    }
+    catch (r3c::CRedisException& ex)
+    {
+        fprintf(stderr, "[%s] %s\n", __FUNCTION__, ex.str().c_str());
+    }
+
+    if (context != NULL)
+        redisFree(context);
+}
+
+// 清理混合负载用到的所有键，由所有线程分担
+void mix_clean_thread(uint8_t index)
+{
+    try
+    {
+        r3c::CRedisClient redis(mooon::argument::redis->value());
+        for (uint32_t i=index; i<mooon::argument::keys->value(); i+=mooon::argument::threads->value())
+        {
+            try
+            {
+                redis.del(get_mix_key(CMD_GET, i));
+                redis.del(get_mix_key(CMD_HGET, i));
+                redis.del(get_mix_key(CMD_LPUSH, i));
+            }
+            catch (r3c::CRedisException& ex)
+            {
+                if (1 == mooon::argument::verbose->value())
+                    fprintf(stderr, "DEL [%u] ERROR: %s\n", i, ex.str().c_str());
+            }
+        }
+    }
+    catch (r3c::CRedisException& ex)
+    {
+        fprintf(stderr, "[%s] %s\n", __FUNCTION__, ex.str().c_str());
+    }
+}
+
+void mix_test()
+{
+    std::string errmsg;
+    if (!parse_mix(&errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        exit(1);
+    }
+    if ("zipfian" == mooon::argument::distribution->value())
+        init_zipfian();
+
+    atomic_set(&sg_success, 0);
+    atomic_set(&sg_failure, 0);
+    for (int command=0; command<CMD_MAX; ++command)
+        atomic_set(&sg_command_failures[command], 0);
+
+    const uint64_t start_ns = mooon::sys::CClock::get_nanoseconds();
+    mooon::sys::CThreadEngine** threads = new mooon::sys::CThreadEngine*[mooon::argument::threads->value()];
+    for (uint8_t i=0; i<mooon::argument::threads->value(); ++i)
+    {
+        if (is_clean_mode())
+            threads[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(mix_clean_thread, i));
+        else
+            threads[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(mix_stress_thread, i));
+    }
+    for (uint8_t i=0; i<mooon::argument::threads->value(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    delete []threads;
+
+    if (is_test_mode())
+    {
+        const double seconds = (mooon::sys::CClock::get_nanoseconds() - start_ns) / 1000000000.0;
+        const unsigned int success = atomic_read(&sg_success);
+        const unsigned int failure = atomic_read(&sg_failure);
+        fprintf(stdout, "mix: %s, distribution: %s, keys: %u, pipeline: %u, %s\n",
+                mooon::argument::mix->c_value(), mooon::argument::distribution->c_value(), mooon::argument::keys->value(),
+                mooon::argument::pipeline->value(),
+                (0 == mooon::argument::rate->value())? "closed loop": mooon::utils::CStringUtils::format_string("open loop at %u/s", mooon::argument::rate->value()).c_str());
+        fprintf(stdout, "seconds: %.3f, success: %u, failure: %u, qps: %.0f\n\n", seconds, success, failure, (success+failure)/seconds);
+        fprintf(stdout, "%-8s %10s %8s %10s %10s %10s %10s %10s %10s (us)\n", "command", "count", "failure", "mean", "p50", "p90", "p99", "p99.9", "max");
+        for (int command=0; command<CMD_MAX; ++command)
+        {
+            mooon::sys::CHistogramSnapshot snapshot;
+            sg_histograms[command].get_snapshot(&snapshot);
+            if (0 == snapshot.get_count())
+                continue;
+            fprintf(stdout, "%-8s %10" PRIu64" %8d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                    sg_command_names[command], snapshot.get_count(), atomic_read(&sg_command_failures[command]),
+                    snapshot.get_mean()/1000.0, snapshot.get_percentile(50)/1000.0, snapshot.get_percentile(90)/1000.0,
+                    snapshot.get_percentile(99)/1000.0, snapshot.get_percentile(99.9)/1000.0, snapshot.get_max()/1000.0);
+        }
+    }
+}
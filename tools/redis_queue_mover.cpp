@@ -19,7 +19,12 @@
  * 搬移redis队列工具，用于将redis一个队列的数据复制到另一队列中，要求为左进右出
  */
 #include <r3c/r3c.h>
+#include <algorithm>
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/clock.h>
+#include <mooon/sys/disk_queue.h>
+#include <mooon/sys/metrics.h>
+#include <mooon/sys/record_reader.h>
 #include <mooon/sys/safe_logger.h>
 #include <mooon/sys/signal_handler.h>
 #include <mooon/sys/thread_engine.h>
@@ -107,12 +112,35 @@ INTEGER_ARG_DEFINE(int, retry_interval, 100, 1, 1000000, "Interval in millisecon
 // 批量数，即一次批量移动多少
 INTEGER_ARG_DEFINE(int, batch, 1, 1, 100000, "Batch to move");
 
+// 是否以Lua脚本批量移动（要求源为redis）
+// 为1时每批只需两次网络往返：一次EVAL原子地从源队列右端取出batch个并放入暂存队列，
+// 一次LPUSH将整批写入目标队列，暂存队列在下一批的EVAL中才被删除，
+// 因此进程在两者之间退出时，数据仍在暂存队列中，重启后先将其写入目标队列（至少一次，可能重复）。
+// 暂存队列的key为“{源key}:staging:线程序号”（源key已有hash tag时为“源key:staging:线程序号”），
+// 和源key在同一个slot，指定了label时再加上“:label”
+INTEGER_ARG_DEFINE(int, pipeline, 0, 0, 1, "Move a batch atomically by Lua with a staging list (at-least-once), requires --src_redis");
+
+// 目标redis不可用时的溢出目录（可选，仅目标为redis时有效）
+// 写目标失败时，一批数据写入“目录/线程序号”下的磁盘队列（见CDiskQueue）并刷盘后即视为完成，继续从源取，
+// 溢出队列非空时新的批次也先写入溢出队列，目标恢复后按序重放，因此目标长时间不可用时，
+// 既不阻塞源也不丢数据（至少一次，进程重启后可能重复重放上次刷盘后的部分），
+// 溢出队列满（达到spool_segments个段）时退回到一直重试
+STRING_ARG_DEFINE(spool_dir, "", "Directory to spool batches while destination redis is unavailable, e.g., --spool_dir=/data/spool");
+
+// 每个线程的溢出队列最多的段数，每段64MB
+INTEGER_ARG_DEFINE(int, spool_segments, 16, 1, 100000, "Max number of 64MB segments of spool per thread");
+
+// 重放溢出队列失败后，至少间隔多久再重放（单位为毫秒），期间的批次直接写入溢出队列
+INTEGER_ARG_DEFINE(int, spool_retry_interval, 1000, 1, 1000000, "Interval in milliseconds to replay spool after failure");
+
 // label
 // 可选的，
 // 用来区分不同的 redis_queue_mover 进程，
 // 以方便监控识别
 STRING_ARG_DEFINE(label, "", "Used to distinguish between different processes, e.g., --label='test'");
 
+static mooon::sys::CLatencyHistogram g_pull_histogram; // 取一批的耗时
+static mooon::sys::CLatencyHistogram g_push_histogram; // 写一批的耗时
 static mooon::sys::CAtomic<bool> g_stop_myself(false); // 是否因为自身原因停止，比如因为参数错误
 static mooon::sys::CAtomic<bool> g_stop(false); // 是否停止工作
 #if __WORDSIZE==64
@@ -120,12 +148,19 @@ static atomic8_t g_num_moved;
 #else
 static atomic_t g_num_moved;
 #endif
+static __thread mooon::sys::CDiskQueue* sg_spool = NULL; // 本线程的溢出队列，未指定spool_dir时为NULL
+static __thread uint64_t sg_spool_failed_milliseconds = 0; // 最近一次重放失败的时间
 
 static void stop_myself_if_need();
 static void on_terminated();
 static void signal_thread_proc(); // 信号线程
 static void stat_thread_proc(); // 统计线程
 static void move_thread_proc(int thread_index); // 移动线程
+static void pipeline_move(int thread_index, r3c::CRedisClient* src_redis, r3c::CRedisClient* dst_redis, int dst_fd); // 以Lua脚本批量移动
+static bool push_batch(
+        r3c::CRedisClient* dst_redis, int dst_fd, const std::string& dst_key,
+        const std::vector<std::string>& values, uint32_t* num_moved, uint32_t* old_num_moved);
+static bool replay_spool(r3c::CRedisClient* dst_redis, const std::string& dst_key);
 static std::string get_src_key(int queue_index);
 static std::string get_dst_key(int queue_index);
 
@@ -192,6 +227,8 @@ int main(int argc, char* argv[])
         MYLOG_INFO("Number of batch to move: %d.\n", mooon::argument::batch->value());
         MYLOG_INFO("Only prefix of source: %d.\n", mooon::argument::src_only_prefix->value());
         MYLOG_INFO("Only prefix of destination: %d.\n", mooon::argument::dst_only_prefix->value());
+        MYLOG_INFO("Pipeline: %d.\n", mooon::argument::pipeline->value());
+        MYLOG_INFO("Spool directory: %s.\n", mooon::argument::spool_dir->c_value());
 
         mooon::sys::CSignalHandler::block_signal(SIGTERM);
         mooon::sys::CThreadEngine* signal_thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&signal_thread_proc));
@@ -296,10 +333,25 @@ void stat_thread_proc()
                         last_num_moved, old_num_moved, last_num_moved - old_num_moved, num_moved);
             }
 
+            // 本时间段内每批取和写的耗时（微秒）
+            mooon::sys::CHistogramSnapshot pull_snapshot, push_snapshot;
+            g_pull_histogram.get_snapshot(&pull_snapshot, true);
+            g_push_histogram.get_snapshot(&push_snapshot, true);
+            if (pull_snapshot.get_count() > 0)
+            {
+                stat_logger->log_raw(" pull %" PRIu64" p50 %" PRIu64"us p99 %" PRIu64"us max %" PRIu64"us,"
+                                     " push %" PRIu64" p50 %" PRIu64"us p99 %" PRIu64"us max %" PRIu64"us LATENCY\n",
+                        pull_snapshot.get_count(), pull_snapshot.get_percentile(50)/1000,
+                        pull_snapshot.get_percentile(99)/1000, pull_snapshot.get_max()/1000,
+                        push_snapshot.get_count(), push_snapshot.get_percentile(50)/1000,
+                        push_snapshot.get_percentile(99)/1000, push_snapshot.get_max()/1000);
+            }
+
             old_num_moved = last_num_moved;
-            delete stat_logger;
-            stat_logger = NULL;
         }
+
+        delete stat_logger;
+        stat_logger = NULL;
     }
     catch (mooon::sys::CSyscallException& ex)
     {
@@ -319,7 +371,8 @@ void move_thread_proc(int thread_index)
     const std::string& dst_key = get_dst_key(thread_index % num_queues); // 目标key
     mooon::utils::ScopedPtr<r3c::CRedisClient> src_redis;
     mooon::utils::ScopedPtr<r3c::CRedisClient> dst_redis;
-    FILE* src_fp = NULL;
+    mooon::utils::ScopedPtr<mooon::sys::CRecordReader> src_reader;
+    mooon::utils::ScopedPtr<mooon::sys::CDiskQueue> spool;
     int dst_fd = -1;
     uint32_t num_moved = 0; // 已移动的数目
     uint32_t old_num_moved = 0; // 上一次移动的数目
@@ -336,9 +389,8 @@ void move_thread_proc(int thread_index)
         }
         else {
             const std::string src_file = mooon::utils::CStringUtils::format_string("%s.%d", mooon::argument::src_file->c_value(), thread_index);
-            src_fp = fopen(src_file.c_str(), "r");
-            if (src_fp == NULL)
-                THROW_SYSCALL_EXCEPTION(strerror(errno), errno, "open");
+            src_reader.reset(new mooon::sys::CRecordReader);
+            src_reader->open(src_file);
         }
         // destination
         if (!mooon::argument::dst_redis->value().empty()) {
@@ -353,7 +405,28 @@ void move_thread_proc(int thread_index)
             if (dst_fd == -1)
                 THROW_SYSCALL_EXCEPTION(strerror(errno), errno, "open");
         }
+        if (!mooon::argument::spool_dir->value().empty() && (dst_redis != NULL))
+        {
+            mooon::sys::CDiskQueuePolicy policy;
+            const std::string spool_dir = mooon::utils::CStringUtils::format_string("%s/%d", mooon::argument::spool_dir->c_value(), thread_index);
+            policy.max_segments = static_cast<uint32_t>(mooon::argument::spool_segments->value());
+            policy.sync_bytes = 0; // 每批写入后由spool_batch刷盘
+            policy.sync_milliseconds = 0;
+            spool.reset(new mooon::sys::CDiskQueue);
+            spool->open(spool_dir, policy);
+            sg_spool = spool.get();
+            MYLOG_INFO("[%s] spool: %s, %" PRIu64" records.\n", dst_key.c_str(), spool_dir.c_str(), spool->get_record_number());
+        }
         MYLOG_INFO("[%s] => [%s].\n", src_key.c_str(), dst_key.c_str());
+
+        if ((1 == mooon::argument::pipeline->value()) && (src_redis != NULL))
+        {
+            pipeline_move(thread_index, src_redis.get(), dst_redis.get(), dst_fd);
+            if (dst_fd != -1)
+                close(dst_fd);
+            MYLOG_INFO("RedisQueueMover thread(%d) exit now.\n", thread_index);
+            return;
+        }
     }
     catch (mooon::sys::CSyscallException& ex)
     {
@@ -364,8 +437,6 @@ void move_thread_proc(int thread_index)
     catch (r3c::CRedisException& ex)
     {
         MYLOG_ERROR("%s.\n", ex.str().c_str());
-        if (src_fp != NULL)
-            fclose(src_fp);
         if (dst_fd != -1)
             close(dst_fd);
         MYLOG_INFO("RedisQueueMover thread(%d) exit now.\n", thread_index);
@@ -390,20 +461,19 @@ void move_thread_proc(int thread_index)
                 }
                 else
                 {
-                    char line[mooon::SIZE_4K];
-                    if (fgets(line, sizeof(line)-1, src_fp)) {
+                    // 文件被映射到内存，记录不含换行符，读完即结束
+                    std::string_view record;
+                    if (!src_reader->next(&record)) {
                         g_stop = true;
-                        if (errno != 0)
-                            MYLOG_ERROR("Reading file://%s error://%s.\n", mooon::argument::src_file->c_value(), strerror(errno));
                         break;
                     }
-                    value = line;
+                    value.assign(record.data(), record.size());
                 }
                 if (!mooon::argument::dst_redis->value().empty()) {
                     values.push_back(value); // 待写入目标队列的数据
                 }
                 else { // 数据不写入队列，而是落到文件中
-                    if (value[value.size()-1] != '\n')
+                    if (value.empty() || (value[value.size()-1] != '\n'))
                         value.append("\n");
                     if (write(dst_fd, value.data(), value.size()) == -1) {
                         MYLOG_ERROR("Writing file://%s error://%s: %s.\n", mooon::argument::dst_file->c_value(), strerror(errno), value.c_str());
@@ -420,46 +490,313 @@ void move_thread_proc(int thread_index)
         } // for
         if (values.empty())
         {
+            // 源空闲时重放溢出队列
+            if (dst_redis != NULL)
+                (void)replay_spool(dst_redis.get(), dst_key);
             mooon::sys::CUtils::millisleep(retry_interval);
             continue;
         }
 
-        // 数据写入目标队列
-        while (!values.empty())
+        // 数据写入目标队列，失败时写入溢出队列或一直重试
+        if (!push_batch(dst_redis.get(), dst_fd, dst_key, values, &num_moved, &old_num_moved))
+            break;
+    } // while (!g_stop)
+
+    if (dst_fd != -1)
+        close(dst_fd);
+    MYLOG_INFO("RedisQueueMover thread(%d) exit now.\n", thread_index);
+}
+
+// 暂存队列的key，和源key在同一个slot
+static std::string get_staging_key(const std::string& src_key, int thread_index)
+{
+    const std::string::size_type left = src_key.find('{');
+    const std::string::size_type right = (std::string::npos == left)? std::string::npos: src_key.find('}', left+1);
+    const bool has_tag = (right != std::string::npos) && (right > left+1);
+    std::string staging_key = has_tag? src_key: "{" + src_key + "}";
+
+    staging_key += mooon::utils::CStringUtils::format_string(":staging:%d", thread_index);
+    if (!mooon::argument::label->value().empty())
+        staging_key += ":" + mooon::argument::label->value();
+    return staging_key;
+}
+
+// 将一批写入溢出队列并刷盘，未指定spool_dir或溢出队列满时返回false
+// 满时已写入的部分仍会被重放，调用者重试整批，即可能重复（至少一次）
+static bool spool_batch(const std::string& dst_key, const std::vector<std::string>& values)
+{
+    if (NULL == sg_spool)
+        return false;
+
+    try
+    {
+        for (std::vector<std::string>::size_type i=0; i<values.size(); ++i)
         {
-            try
+            if (!sg_spool->push(values[i].data(), static_cast<uint32_t>(values[i].size())))
             {
-                if (dst_redis != NULL)
-                    dst_redis->lpush(dst_key, values);
+                sg_spool->sync();
+                MYLOG_ERROR("[%s] spool is full: %" PRIu64" records.\n", dst_key.c_str(), sg_spool->get_record_number());
+                return false;
+            }
+        }
 
-                const uint32_t num_moved_ = static_cast<uint32_t>(values.size());
+        sg_spool->sync();
+        return true;
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("[%s] spool: %s.\n", dst_key.c_str(), ex.str().c_str());
+        return false;
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        // 单条超过段大小
+        MYLOG_ERROR("[%s] spool: %s.\n", dst_key.c_str(), ex.str().c_str());
+        return false;
+    }
+}
+
+// 按序将溢出队列中的写入目标，每次最多batch条，
+// 返回true表示溢出队列为空，返回false表示目标仍不可用或距上次失败不足spool_retry_interval
+bool replay_spool(r3c::CRedisClient* dst_redis, const std::string& dst_key)
+{
+    if ((NULL == sg_spool) || sg_spool->empty())
+        return true;
+
+    const uint64_t now_milliseconds = mooon::sys::CClock::get_milliseconds();
+    if (now_milliseconds < sg_spool_failed_milliseconds + static_cast<uint64_t>(mooon::argument::spool_retry_interval->value()))
+        return false;
+
+    const size_t batch = static_cast<size_t>(mooon::argument::batch->value());
+    std::vector<std::string_view> records;
+    std::vector<std::string> values;
+    uint64_t num_replayed = 0;
+    try
+    {
+        while (!g_stop && !sg_spool->empty())
+        {
+            const size_t number = sg_spool->peek(&records, batch);
+            values.clear();
+            for (size_t i=0; i<number; ++i)
+                values.push_back(std::string(records[i].data(), records[i].size()));
+
+            dst_redis->lpush(dst_key, values);
+            sg_spool->pop(number);
+            num_replayed += number;
 #if __WORDSIZE==64
-                atomic8_add(num_moved_, &g_num_moved);
+            atomic8_add(static_cast<uint32_t>(number), &g_num_moved);
 #else
-                atomic_add(num_moved_, &g_num_moved);
+            atomic_add(static_cast<uint32_t>(number), &g_num_moved);
 #endif
+        }
+    }
+    catch (r3c::CRedisException& ex)
+    {
+        MYLOG_ERROR("[%s] replay: %s.\n", dst_key.c_str(), ex.str().c_str());
+        sg_spool_failed_milliseconds = now_milliseconds;
+    }
+
+    try
+    {
+        // 保存消费位置并回收重放完的段
+        if (num_replayed > 0)
+        {
+            sg_spool->sync();
+            MYLOG_INFO("[%s] replayed %" PRIu64" from spool, %" PRIu64" left.\n", dst_key.c_str(), num_replayed, sg_spool->get_record_number());
+        }
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        MYLOG_ERROR("[%s] spool: %s.\n", dst_key.c_str(), ex.str().c_str());
+    }
+    return sg_spool->empty();
+}
 
-                num_moved += num_moved_;
-                if (num_moved - old_num_moved >= static_cast<uint32_t>(mooon::argument::tick->value()))
+// 将一批写入目标，values的顺序为先出队的在前，
+// 失败时写入溢出队列（如果有），否则一直重试直到成功或停止
+bool push_batch(
+        r3c::CRedisClient* dst_redis, int dst_fd, const std::string& dst_key,
+        const std::vector<std::string>& values, uint32_t* num_moved, uint32_t* old_num_moved)
+{
+    while (!g_stop)
+    {
+        try
+        {
+            const uint64_t start_nanoseconds = mooon::sys::CClock::get_nanoseconds();
+            if (dst_redis != NULL)
+            {
+                // 溢出队列中的更早，须先写入，未写完时本批也进入溢出队列以保持顺序
+                if (!replay_spool(dst_redis, dst_key))
                 {
-                    old_num_moved = num_moved;
-                    MYLOG_INFO("[%s]=>[%s]: %u.\n", src_key.c_str(), dst_key.c_str(), num_moved);
+                    if (spool_batch(dst_key, values))
+                        return true;
+                    mooon::sys::CUtils::millisleep(mooon::argument::retry_interval->value());
+                    continue;
                 }
-                break;
+
+                // 多值LPUSH依次插入头部，先出队的在前则仍先出队
+                dst_redis->lpush(dst_key, values);
             }
-            catch (r3c::CRedisException& ex)
+            else
             {
-                MYLOG_ERROR("[%s]=>[%s]: %s.\n", src_key.c_str(), dst_key.c_str(), ex.str().c_str());
-                mooon::sys::CUtils::millisleep(retry_interval);
+                std::string lines;
+                for (std::vector<std::string>::size_type i=0; i<values.size(); ++i)
+                {
+                    lines.append(values[i]);
+                    if (values[i].empty() || (values[i][values[i].size()-1] != '\n'))
+                        lines.append("\n");
+                }
+                if (write(dst_fd, lines.data(), lines.size()) != static_cast<ssize_t>(lines.size()))
+                {
+                    MYLOG_ERROR("Writing file://%s error://%s.\n", mooon::argument::dst_file->c_value(), strerror(errno));
+                    g_stop = true;
+                    return false;
+                }
             }
-        } // while (!values.empty())
-    } // while (!g_stop)
+            g_push_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_nanoseconds);
 
-    if (src_fp != NULL)
-        fclose(src_fp);
-    if (dst_fd != -1)
-        close(dst_fd);
-    MYLOG_INFO("RedisQueueMover thread(%d) exit now.\n", thread_index);
+            const uint32_t num_moved_ = static_cast<uint32_t>(values.size());
+#if __WORDSIZE==64
+            atomic8_add(num_moved_, &g_num_moved);
+#else
+            atomic_add(num_moved_, &g_num_moved);
+#endif
+            *num_moved += num_moved_;
+            if (*num_moved - *old_num_moved >= static_cast<uint32_t>(mooon::argument::tick->value()))
+            {
+                *old_num_moved = *num_moved;
+                MYLOG_INFO("[%s]: %u.\n", dst_key.c_str(), *num_moved);
+            }
+            return true;
+        }
+        catch (r3c::CRedisException& ex)
+        {
+            MYLOG_ERROR("[%s]: %s.\n", dst_key.c_str(), ex.str().c_str());
+            sg_spool_failed_milliseconds = mooon::sys::CClock::get_milliseconds();
+            if (spool_batch(dst_key, values))
+                return true;
+            mooon::sys::CUtils::millisleep(mooon::argument::retry_interval->value());
+        }
+    }
+
+    return false;
+}
+
+// 将暂存队列中的写入目标，暂存队列在下一次EVAL时才删除
+static bool recover_staging(
+        r3c::CRedisClient* src_redis, r3c::CRedisClient* dst_redis, int dst_fd,
+        const std::string& staging_key, const std::string& dst_key, uint32_t* num_moved, uint32_t* old_num_moved)
+{
+    std::vector<std::string> values;
+    while (!g_stop)
+    {
+        try
+        {
+            src_redis->lrange(staging_key, 0, -1, &values);
+            break;
+        }
+        catch (r3c::CRedisException& ex)
+        {
+            MYLOG_ERROR("[%s]: %s.\n", staging_key.c_str(), ex.str().c_str());
+            mooon::sys::CUtils::millisleep(mooon::argument::retry_interval->value());
+        }
+    }
+    if (g_stop)
+        return false;
+    if (values.empty())
+        return true;
+
+    // 暂存的顺序同LRANGE，反转为先出队的在前
+    MYLOG_INFO("[%s] recover %d from staging.\n", staging_key.c_str(), static_cast<int>(values.size()));
+    std::reverse(values.begin(), values.end());
+    return push_batch(dst_redis, dst_fd, dst_key, values, num_moved, old_num_moved);
+}
+
+// 先删除上一批的暂存（上一批已写入目标），再从源队列右端原子地取出最多ARGV[1]个并放入暂存队列，
+// 返回值的顺序同LRANGE，即后出队的在前；unpack受Lua栈大小限制，所以分段RPUSH
+static const char* sg_pull_script =
+    "redis.call('DEL', KEYS[2])\n"
+    "local values = redis.call('LRANGE', KEYS[1], -tonumber(ARGV[1]), -1)\n"
+    "local n = #values\n"
+    "if n > 0 then\n"
+    "    redis.call('LTRIM', KEYS[1], 0, -n-1)\n"
+    "    for i=1,n,1000 do\n"
+    "        redis.call('RPUSH', KEYS[2], unpack(values, i, math.min(i+999, n)))\n"
+    "    end\n"
+    "end\n"
+    "return values\n";
+
+void pipeline_move(int thread_index, r3c::CRedisClient* src_redis, r3c::CRedisClient* dst_redis, int dst_fd)
+{
+    const int num_queues = mooon::argument::queues->value();
+    const std::string& src_key = get_src_key(thread_index % num_queues);
+    const std::string& dst_key = get_dst_key(thread_index % num_queues);
+    const std::string& staging_key = get_staging_key(src_key, thread_index);
+    const std::string& batch = mooon::utils::CStringUtils::int_tostring(mooon::argument::batch->value());
+    std::vector<std::string> keys;
+    std::vector<std::string> parameters;
+    std::vector<std::string> values;
+    uint32_t num_moved = 0;
+    uint32_t old_num_moved = 0;
+
+    keys.push_back(src_key);
+    keys.push_back(staging_key);
+    parameters.push_back(batch);
+    MYLOG_INFO("[%s] => [%s] staging: %s.\n", src_key.c_str(), dst_key.c_str(), staging_key.c_str());
+
+    // 上次退出时未确认的一批，重新写入目标
+    if (!recover_staging(src_redis, dst_redis, dst_fd, staging_key, dst_key, &num_moved, &old_num_moved))
+        return;
+
+    while (!g_stop)
+    {
+        try
+        {
+            const uint64_t start_nanoseconds = mooon::sys::CClock::get_nanoseconds();
+            const r3c::RedisReplyHelper redis_reply = src_redis->eval(sg_pull_script, keys, parameters);
+            g_pull_histogram.record(mooon::sys::CClock::get_nanoseconds() - start_nanoseconds);
+
+            values.clear();
+            if (redis_reply && (REDIS_REPLY_ARRAY == redis_reply->type))
+            {
+                // 反转为先出队的在前
+                for (size_t i=redis_reply->elements; i>0; --i)
+                {
+                    const redisReply* element = redis_reply->element[i-1];
+                    values.push_back(std::string(element->str, element->len));
+                }
+            }
+        }
+        catch (r3c::CRedisException& ex)
+        {
+            // EVAL可能已执行只是未收到响应，须先写入暂存的，否则下一次EVAL会删除它们
+            MYLOG_ERROR("[%s]: %s.\n", src_key.c_str(), ex.str().c_str());
+            mooon::sys::CUtils::millisleep(mooon::argument::retry_interval->value());
+            if (!recover_staging(src_redis, dst_redis, dst_fd, staging_key, dst_key, &num_moved, &old_num_moved))
+                return;
+            continue;
+        }
+
+        if (values.empty())
+        {
+            if (dst_redis != NULL)
+                (void)replay_spool(dst_redis, dst_key);
+            mooon::sys::CUtils::millisleep(mooon::argument::retry_interval->value());
+            continue;
+        }
+        if (!push_batch(dst_redis, dst_fd, dst_key, values, &num_moved, &old_num_moved))
+            return; // 未写入的一批留在暂存队列中
+    }
+
+    // 最后一批已写入目标，删除暂存
+    try
+    {
+        src_redis->del(staging_key);
+    }
+    catch (r3c::CRedisException& ex)
+    {
+        MYLOG_ERROR("[%s]: %s.\n", staging_key.c_str(), ex.str().c_str());
+    }
 }
 
 // queue_index 队列序号，从0开始的递增值，最大值为队列数减一
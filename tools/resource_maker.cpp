@@ -12,8 +12,21 @@
 // xxd -i x.jpg x.c
 //
 // C++资源编译工具，用于将任何格式的文件编译成C++代码
-// 优点：单个.cpp文件，无其它依赖，一句编译后即可使用
-// 编译：g++ -Wall -g -o resource_maker resource_maker.cpp
+// 优点：单个.cpp文件，一句编译后即可使用
+// 编译：g++ -Wall -g -o resource_maker resource_maker.cpp -I../include -lmooon -lz -lpthread
+//
+// 资源文件较多或较大时，应使用资源包（bundle）模式，不再为每个文件生成数组，
+// 而是将所有文件打包成一个带索引的资源包（可按文件压缩），运行时用mooon::sys::CResourceBundle零拷贝访问：
+// resource_maker --bundle=admin.bundle [--compression=zstd] [--incbin=admin | --append=可执行文件] 文件...
+// 1) --compression：每个文件单独压缩，可为gzip、zlib、zstd或lz4（后两者取决于编译mooon时是否找到库），
+//    压缩后不变小的文件不压缩，压缩的文件在第一次访问时解压并缓存
+// 2) --incbin：另外生成admin.bundle.cpp，以.incbin将资源包编译进程序，
+//    定义了两个全局符号mooon_resource_admin和mooon_resource_admin_size，使用：
+//    extern "C" const char mooon_resource_admin[];
+//    extern "C" const uint64_t mooon_resource_admin_size;
+//    bundle.open(mooon_resource_admin, mooon_resource_admin_size);
+// 3) --append：将资源包附加到已编译好的可执行文件末尾，程序中以bundle.open_self()打开
+// 资源的名字即命令行中的文件路径（去掉开头的“./”），如bundle.get("html/index.html", &size)
 //
 // 编译后，会生成与资源文件对应的.cpp文件，访.cpp文件包含两个全局变量：
 // 1) size变量：存储资源文件的字节数大小，变量名同文件名，但不包含扩展名部分
@@ -40,6 +53,8 @@
 // }
 #include <error.h>
 #include <fstream>
+#include <mooon/sys/resource_bundle.h>
+#include <mooon/utils/exception.h>
 #include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,6 +63,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 // 从文件路径中扣出不带斜杠结尾的目录路径
 static std::string extract_dirpath_without_slash(const std::string& filepath);
@@ -68,11 +84,20 @@ static bool write_cpp_file(const std::string& resource_cpp_filepath, const std::
 // 如：a变成0x61，1变成0x31，。。。
 static std::string dec2hex(unsigned char c);
 
+// 资源包模式，参数为“--bundle=”开头的命令行
+static int make_bundle(int argc, char* argv[]);
+
+// 生成以.incbin嵌入资源包的.cpp文件
+static bool write_incbin_file(const std::string& incbin_filepath, const std::string& bundle_filepath, const std::string& symbol);
+
 // 用法，带2个参数：
 // 参数1：resource_maker 资源文件
 // 参数2：文件名前缀（可选，默认为res_，如果文件名是骆驼命名风格，建议改为Res）
 int main(int argc, char* argv[])
 {
+    if ((argc > 1) && (0 == strncmp(argv[1], "--bundle=", sizeof("--bundle=")-1)))
+        return make_bundle(argc, argv);
+
     std::string filename_prefix = (3 == argc)? argv[2]: "res_";
     std::string resource_filepath = argv[1];
     std::string resource_dirpath = extract_dirpath_without_slash(resource_filepath);
@@ -224,3 +249,115 @@ std::string dec2hex(unsigned char c)
     snprintf(buf, sizeof(buf), "0x%02x", c); // 注意c类型如果为char，则需要强制转换成unsigned类型
     return buf;
 }
+
+int make_bundle(int argc, char* argv[])
+{
+    std::string bundle_filepath = argv[1] + sizeof("--bundle=") - 1;
+    std::string compression_name = "none";
+    std::string incbin_symbol;
+    std::string append_filepath;
+    std::vector<std::string> filepaths;
+
+    for (int i=2; i<argc; ++i)
+    {
+        if (0 == strncmp(argv[i], "--compression=", sizeof("--compression=")-1))
+            compression_name = argv[i] + sizeof("--compression=") - 1;
+        else if (0 == strncmp(argv[i], "--incbin=", sizeof("--incbin=")-1))
+            incbin_symbol = argv[i] + sizeof("--incbin=") - 1;
+        else if (0 == strncmp(argv[i], "--append=", sizeof("--append=")-1))
+            append_filepath = argv[i] + sizeof("--append=") - 1;
+        else
+            filepaths.push_back(argv[i]);
+    }
+    if (bundle_filepath.empty() || filepaths.empty())
+    {
+        fprintf(stderr, "usage: %s --bundle=bundle_filepath [--compression=zstd] [--incbin=symbol] [--append=executable] resource_filepath ...\n", basename(argv[0]));
+        return 1;
+    }
+
+    try
+    {
+        mooon::sys::CResourceBundleWriter writer;
+        const mooon::utils::compression_t compression = mooon::utils::get_compression_by_name(compression_name);
+
+        for (std::vector<std::string>::size_type i=0; i<filepaths.size(); ++i)
+        {
+            std::string buffer;
+            std::string name = filepaths[i];
+
+            if (!file2string(filepaths[i], &buffer))
+                return 1;
+            buffer.resize(buffer.size() - 1); // 去掉file2string加的结尾符
+            while (0 == name.compare(0, 2, "./"))
+                name.erase(0, 2);
+
+            writer.add(name, buffer, compression);
+            fprintf(stdout, "resource: %s (%zu bytes)\n", name.c_str(), buffer.size());
+        }
+
+        writer.write_file(bundle_filepath);
+        fprintf(stdout, "bundle file: %s\n", bundle_filepath.c_str());
+        if (!append_filepath.empty())
+        {
+            writer.append_to_file(append_filepath);
+            fprintf(stdout, "appended to: %s\n", append_filepath.c_str());
+        }
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        return 1;
+    }
+
+    if (!incbin_symbol.empty())
+    {
+        const std::string incbin_filepath = bundle_filepath + ".cpp";
+        if (!write_incbin_file(incbin_filepath, bundle_filepath, incbin_symbol))
+            return 1;
+        fprintf(stdout, "incbin file: %s\n", incbin_filepath.c_str());
+    }
+
+    return 0;
+}
+
+bool write_incbin_file(const std::string& incbin_filepath, const std::string& bundle_filepath, const std::string& symbol)
+{
+    std::ofstream fs(incbin_filepath.c_str());
+    if (!fs)
+    {
+        fprintf(stderr, "open %s error: %m\n", incbin_filepath.c_str());
+        return false;
+    }
+
+    // .incbin的路径相对于汇编器的工作目录，因此总是用绝对路径
+    char* bundle_realpath = realpath(bundle_filepath.c_str(), NULL);
+    if (NULL == bundle_realpath)
+    {
+        fprintf(stderr, "realpath %s error: %m\n", bundle_filepath.c_str());
+        return false;
+    }
+
+    const std::string name = "mooon_resource_" + symbol;
+    fs << "// DO NOT EDIT!!!" << std::endl;
+    fs << "// this file is auto generated by resource_maker" << std::endl;
+    fs << "// edit the generator if necessary" << std::endl;
+    fs << "// extern \"C\" const char " << name << "[];" << std::endl;
+    fs << "// extern \"C\" const uint64_t " << name << "_size;" << std::endl;
+    fs << std::endl;
+    fs << "__asm__(" << std::endl;
+    fs << "    \".section .rodata\\n\"" << std::endl;
+    fs << "    \".balign 16\\n\"" << std::endl;
+    fs << "    \".global " << name << "\\n\"" << std::endl;
+    fs << "    \"" << name << ":\\n\"" << std::endl;
+    fs << "    \".incbin \\\"" << bundle_realpath << "\\\"\\n\"" << std::endl;
+    fs << "    \"" << name << "_end:\\n\"" << std::endl;
+    fs << "    \".balign 8\\n\"" << std::endl;
+    fs << "    \".global " << name << "_size\\n\"" << std::endl;
+    fs << "    \"" << name << "_size:\\n\"" << std::endl;
+    fs << "    \".quad " << name << "_end - " << name << "\\n\"" << std::endl;
+    fs << "    \".previous\\n\"" << std::endl;
+    fs << ");" << std::endl;
+
+    free(bundle_realpath);
+    return true;
+}
@@ -0,0 +1,121 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 静态哈希表生成工具，将文本格式的词典（每行一个键值，键和值以分隔符隔开）生成为
+// mooon::sys::CStaticHashTable的文件，运行时以mmap打开，不必在启动时逐行解析，示例：
+// 1) 生成：static_hash_maker --input=ip_geo.txt --output=ip_geo.sht --delimiter=','
+// 2) 查找：static_hash_maker --output=ip_geo.sht --find='1.0.1.0'
+// 行中第一个分隔符之前为键，之后（可以包含分隔符）为值，没有分隔符的行值为空，空行被忽略，键重复时报错
+#include <mooon/sys/clock.h>
+#include <mooon/sys/record_reader.h>
+#include <mooon/sys/static_hash_table.h>
+#include <mooon/sys/syscall_exception.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/utils/exception.h>
+#include <stdio.h>
+
+STRING_ARG_DEFINE(input, "", "text file of keys and values, one per line");
+STRING_ARG_DEFINE(output, "", "static hash table file");
+STRING_ARG_DEFINE(delimiter, "\t", "delimiter between key and value, default is tab");
+STRING_ARG_DEFINE(find, "", "key to find in the table of --output instead of making it");
+
+static int find_key()
+{
+    mooon::sys::CStaticHashTable table;
+    std::string_view value;
+
+    table.open_file(mooon::argument::output->value());
+    if (!table.find(mooon::argument::find->value(), &value))
+    {
+        fprintf(stderr, "%s not found in %" PRIu64" keys\n", mooon::argument::find->c_value(), table.get_key_number());
+        return 1;
+    }
+
+    fprintf(stdout, "%.*s\n", static_cast<int>(value.size()), value.data());
+    return 0;
+}
+
+static int make_table()
+{
+    // 命令行中不便输入制表符，“\t”也表示制表符
+    const char delimiter = (mooon::argument::delimiter->value() == "\\t")? '\t': mooon::argument::delimiter->value()[0];
+    const uint64_t start_milliseconds = mooon::sys::CClock::get_milliseconds();
+    mooon::sys::CStaticHashTableWriter writer;
+    mooon::sys::CRecordReader reader;
+    std::string_view record;
+
+    reader.open(mooon::argument::input->value());
+    while (reader.next(&record))
+    {
+        if (record.empty())
+            continue;
+
+        const std::string_view::size_type pos = record.find(delimiter);
+        if (std::string_view::npos == pos)
+            writer.add(record, std::string_view());
+        else
+            writer.add(record.substr(0, pos), record.substr(pos+1));
+    }
+
+    writer.write_file(mooon::argument::output->value());
+    fprintf(stdout, "%" PRIu64" keys written to %s in %" PRIu64"ms\n",
+            writer.get_key_number(), mooon::argument::output->c_value(),
+            mooon::sys::CClock::get_milliseconds() - start_milliseconds);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+    if (mooon::argument::output->value().empty())
+    {
+        fprintf(stderr, "parameter[--output] is not set\n");
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+    if (mooon::argument::find->value().empty() &&
+        (mooon::argument::input->value().empty() || mooon::argument::delimiter->value().empty()))
+    {
+        fprintf(stderr, "parameter[--input] or parameter[--delimiter] is not set\n");
+        fprintf(stderr, "%s\n", mooon::utils::g_help_string.c_str());
+        exit(1);
+    }
+
+    try
+    {
+        if (!mooon::argument::find->value().empty())
+            return find_key();
+        return make_table();
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        exit(1);
+    }
+}
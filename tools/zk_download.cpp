@@ -1,6 +1,8 @@
 // Writed by yijian on 2018/11/09
-// 将一个zookeeper节点的数据写入到本地文件
+// 将一个zookeeper节点的数据写入到本地文件，
+// 节点可以是zk_upload分块存储的，或以--recursive=true下载整个子树到本地目录
 #include <mooon/net/zookeeper_helper.h>
+#include <mooon/sys/dir_utils.h>
 #include <mooon/utils/args_parser.h>
 
 // 指定配置文件参数
@@ -12,6 +14,16 @@ STRING_ARG_DEFINE(zookeeper, "", "The zookeeper nodes, example: --zookeeper=127.
 // 指定存储配置的zookeeper节点（需有写权限）
 STRING_ARG_DEFINE(zkpath, "", "The path of zookeeper, example: --zkpath=/tmp/a");
 
+// 是否下载整个子树，为true时--conf为本地目录
+BOOL_STRING_ARG_DEFINE(recursive, "false", "Download the whole subtree into the directory specified by --conf, example: --recursive=true");
+
+// 将数据写入文件
+static void write_file(const std::string& filepath, const std::string& data);
+
+// 以并行的异步读取下载整个子树，
+// 有子节点的节点为目录，它自己的数据（非空时）存为目录下的.zkdata文件
+static int download_subtree(mooon::net::CZookeeperHelper* zookeeper);
+
 int main(int argc, char* argv[])
 {
     std::string confdata;
@@ -54,8 +66,19 @@ int main(int argc, char* argv[])
     {
         mooon::net::CZookeeperHelper zookeeper;
         zookeeper.create_session(mooon::argument::zookeeper->value());
-        const int n = zookeeper.store_data(mooon::argument::conf->value(), mooon::argument::zkpath->value(), false);
-        fprintf(stdout, "bytes: %d\n", n);
+        if (mooon::argument::recursive->is_true())
+        {
+            const int n = download_subtree(&zookeeper);
+            fprintf(stdout, "nodes: %d\n", n);
+        }
+        else
+        {
+            // 兼容未分块存储的节点
+            std::string confdata;
+            const int n = zookeeper.get_chunked_data(mooon::argument::zkpath->value(), &confdata);
+            write_file(mooon::argument::conf->value(), confdata);
+            fprintf(stdout, "bytes: %d\n", n);
+        }
         return 0;
     }
     catch (mooon::sys::CSyscallException& ex)
@@ -69,3 +92,56 @@ int main(int argc, char* argv[])
         exit(1);
     }
 }
+
+void write_file(const std::string& filepath, const std::string& data)
+{
+    int errcode = 0;
+    const int fd = open(filepath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+    {
+        errcode = errno;
+        THROW_SYSCALL_EXCEPTION(mooon::utils::CStringUtils::format_string("open %s failed: %s", filepath.c_str(), strerror(errcode)), errcode, "open");
+    }
+
+    const ssize_t n = write(fd, data.data(), data.size());
+    if (n != static_cast<ssize_t>(data.size()))
+    {
+        errcode = errno;
+        close(fd);
+        THROW_SYSCALL_EXCEPTION(mooon::utils::CStringUtils::format_string("write %s failed: %s", filepath.c_str(), strerror(errcode)), errcode, "write");
+    }
+
+    close(fd);
+}
+
+int download_subtree(mooon::net::CZookeeperHelper* zookeeper)
+{
+    const std::string& zkpath = mooon::argument::zkpath->value();
+    const std::string& dirpath = mooon::argument::conf->value();
+    std::map<std::string, std::string> nodes;
+
+    zookeeper->get_subtree_data(zkpath, &nodes);
+    for (std::map<std::string, std::string>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
+    {
+        const std::string relative_path = iter->first.substr(("/" == zkpath)? 0: zkpath.size());
+        const std::string local_path = dirpath + relative_path;
+
+        // 有序的，子节点总是紧跟在以“/”为前缀的范围内
+        std::map<std::string, std::string>::const_iterator child = nodes.lower_bound(iter->first + "/");
+        const bool has_children = (child != nodes.end()) && (0 == child->first.compare(0, iter->first.size()+1, iter->first + "/"));
+
+        if (has_children)
+        {
+            mooon::sys::CDirUtils::create_directory_recursive(local_path.c_str());
+            if (!iter->second.empty())
+                write_file(local_path + "/.zkdata", iter->second);
+        }
+        else
+        {
+            mooon::sys::CDirUtils::create_directory_byfilepath(local_path.c_str());
+            write_file(local_path, iter->second);
+        }
+    }
+
+    return static_cast<int>(nodes.size());
+}
@@ -12,6 +12,12 @@ STRING_ARG_DEFINE(zookeeper, "", "The zookeeper nodes, example: --zookeeper=127.
 // 指定存储配置的zookeeper节点（需有写权限）
 STRING_ARG_DEFINE(zkpath, "", "The path of zookeeper, example: --zkpath=/tmp/a");
 
+// 分块存储时每块的大小，为0时只有超过节点大小上限的文件才分块（每块512KB）
+INTEGER_ARG_DEFINE(int32_t, chunk_size, 0, 0, 1000*1024, "The chunk size for chunked storage, 0 to chunk only files larger than 1MB, example: --chunk_size=524288");
+
+// 压缩方式，指定时总是分块存储
+STRING_ARG_DEFINE(compression, "none", "The compression of chunked storage: none, gzip, zlib, zstd or lz4, example: --compression=zstd");
+
 // 从配置文件读取配置
 static void read_conf(std::string* confdata);
 
@@ -99,9 +105,23 @@ int upload_conf(const std::string& confdata)
     try
     {
         mooon::net::CZookeeperHelper zookeeper;
+        const mooon::utils::compression_t compression = mooon::utils::get_compression_by_name(mooon::argument::compression->value());
+        const int chunk_size = mooon::argument::chunk_size->value();
+
         zookeeper.create_session(mooon::argument::zookeeper->value());
-        zookeeper.set_zk_data(mooon::argument::zkpath->value(), confdata);
-        fprintf(stdout, "Publish conf to zookeeper ok\n");
+
+        // 小的文件仍直接写入节点，和旧版本的zk_download兼容，
+        // 超过节点大小上限（留出请求头的空间）的分块存储，以zoo_multi原子切换
+        if ((compression != mooon::utils::compression_none) || (chunk_size > 0) || (confdata.size() > mooon::SIZE_1M - mooon::SIZE_4K))
+        {
+            zookeeper.put_chunked_data(mooon::argument::zkpath->value(), confdata, (chunk_size > 0)? chunk_size: mooon::SIZE_512K, compression);
+            fprintf(stdout, "Publish conf to zookeeper ok (chunked, %zu bytes)\n", confdata.size());
+        }
+        else
+        {
+            zookeeper.set_zk_data(mooon::argument::zkpath->value(), confdata);
+            fprintf(stdout, "Publish conf to zookeeper ok\n");
+        }
         return 0;
     }
     catch (mooon::utils::CException& ex)